@@ -14,9 +14,19 @@
 
 #include <limits.h>
 
+#include "access/hash.h"
+#include "access/htup_details.h"
 #include "commands/explain.h"
 #include "executor/instrument.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/builtins.h"
 #include "utils/guc.h"
+#include "utils/timestamp.h"
 
 PG_MODULE_MAGIC;
 
@@ -29,6 +39,9 @@ static bool auto_explain_log_triggers = false;
 static bool auto_explain_log_timing = true;
 static int	auto_explain_log_format = EXPLAIN_FORMAT_TEXT;
 static bool auto_explain_log_nested_statements = false;
+static double auto_explain_sample_rate = 1;
+static bool auto_explain_track_plans = false;
+static int	auto_explain_max_tracked = 1000;
 
 static const struct config_enum_entry format_options[] = {
 	{"text", EXPLAIN_FORMAT_TEXT, false},
@@ -38,28 +51,96 @@ static const struct config_enum_entry format_options[] = {
 	{NULL, 0, false}
 };
 
+/*
+ * Plan tracking remembers, for each statement (identified by database and
+ * query ID), the last few distinct plan fingerprints it ran with, along with
+ * execution timings for each.  That makes it possible to notice a statement
+ * switching to a different plan, and whether the new plan is slower.
+ */
+#define AE_PLANS_PER_QUERY	4
+
+/* Percentage of entries to discard when the table fills up */
+#define AE_DEALLOC_PERCENT	5
+
+#define AUTO_EXPLAIN_PLANS_COLS		10
+
+typedef struct aePlanKey
+{
+	Oid			dbid;			/* database OID */
+	uint32		queryid;		/* query identifier */
+} aePlanKey;
+
+/*
+ * Statistics for one plan of a statement.  A slot with calls == 0 is unused.
+ */
+typedef struct aePlanStats
+{
+	uint32		plan_hash;		/* plan fingerprint */
+	int64		calls;			/* # of sampled executions with this plan */
+	double		total_time;		/* total execution time, in msec */
+	double		min_time;		/* minimum execution time, in msec */
+	double		max_time;		/* maximum execution time, in msec */
+	TimestampTz first_seen;		/* first sampled execution with this plan */
+	TimestampTz last_seen;		/* last sampled execution with this plan */
+} aePlanStats;
+
+typedef struct aePlanEntry
+{
+	aePlanKey	key;			/* hash key of entry - MUST BE FIRST */
+	slock_t		mutex;			/* protects the plans array */
+	aePlanStats plans[AE_PLANS_PER_QUERY];
+} aePlanEntry;
+
+typedef struct aeSharedState
+{
+	LWLock	   *lock;			/* protects hashtable search/modification */
+} aeSharedState;
+
+/* Links to shared memory state */
+static aeSharedState *ae = NULL;
+static HTAB *ae_hash = NULL;
+
 /* Current nesting depth of ExecutorRun calls */
 static int	nesting_level = 0;
 
+/* Is the current top-level statement sampled? */
+static bool current_query_sampled = true;
+
 /* Saved hook values in case of unload */
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
 static ExecutorStart_hook_type prev_ExecutorStart = NULL;
 static ExecutorRun_hook_type prev_ExecutorRun = NULL;
 static ExecutorFinish_hook_type prev_ExecutorFinish = NULL;
 static ExecutorEnd_hook_type prev_ExecutorEnd = NULL;
 
+#define auto_explain_tracking() \
+	(auto_explain_track_plans && ae_hash != NULL)
+
 #define auto_explain_enabled() \
-	(auto_explain_log_min_duration >= 0 && \
-	 (nesting_level == 0 || auto_explain_log_nested_statements))
+	((auto_explain_log_min_duration >= 0 || auto_explain_tracking()) && \
+	 (nesting_level == 0 || auto_explain_log_nested_statements) && \
+	 current_query_sampled)
 
 void		_PG_init(void);
 void		_PG_fini(void);
 
+Datum		auto_explain_plans(PG_FUNCTION_ARGS);
+Datum		auto_explain_plans_reset(PG_FUNCTION_ARGS);
+
+PG_FUNCTION_INFO_V1(auto_explain_plans);
+PG_FUNCTION_INFO_V1(auto_explain_plans_reset);
+
+static void ae_shmem_startup(void);
 static void explain_ExecutorStart(QueryDesc *queryDesc, int eflags);
 static void explain_ExecutorRun(QueryDesc *queryDesc,
 					ScanDirection direction,
 					long count);
 static void explain_ExecutorFinish(QueryDesc *queryDesc);
 static void explain_ExecutorEnd(QueryDesc *queryDesc);
+static void ae_store_plan(QueryDesc *queryDesc, double msec);
+static aePlanEntry *ae_entry_alloc(aePlanKey *key);
+static void ae_entry_dealloc(void);
+static Size ae_memsize(void);
 
 
 /*
@@ -159,8 +240,58 @@ _PG_init(void)
 							 NULL,
 							 NULL);
 
+	DefineCustomRealVariable("auto_explain.sample_rate",
+							 "Fraction of queries to process.",
+							 NULL,
+							 &auto_explain_sample_rate,
+							 1.0,
+							 0.0,
+							 1.0,
+							 PGC_SUSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("auto_explain.track_plans",
+				  "Record plan fingerprints and timings of sampled queries.",
+		 "This has no effect unless auto_explain is in shared_preload_libraries.",
+							 &auto_explain_track_plans,
+							 false,
+							 PGC_SUSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomIntVariable("auto_explain.max_tracked_queries",
+			"Sets the maximum number of queries whose plans are tracked.",
+							NULL,
+							&auto_explain_max_tracked,
+							1000,
+							100,
+							INT_MAX,
+							PGC_POSTMASTER,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
 	EmitWarningsOnPlaceholders("auto_explain");
 
+	/*
+	 * The plan tracking table lives in shared memory, so it is only
+	 * available when we are loaded at postmaster start.
+	 */
+	if (process_shared_preload_libraries_in_progress)
+	{
+		RequestAddinShmemSpace(ae_memsize());
+		RequestAddinLWLocks(1);
+
+		prev_shmem_startup_hook = shmem_startup_hook;
+		shmem_startup_hook = ae_shmem_startup;
+	}
+
 	/* Install hooks. */
 	prev_ExecutorStart = ExecutorStart_hook;
 	ExecutorStart_hook = explain_ExecutorStart;
@@ -179,22 +310,75 @@ void
 _PG_fini(void)
 {
 	/* Uninstall hooks. */
+	shmem_startup_hook = prev_shmem_startup_hook;
 	ExecutorStart_hook = prev_ExecutorStart;
 	ExecutorRun_hook = prev_ExecutorRun;
 	ExecutorFinish_hook = prev_ExecutorFinish;
 	ExecutorEnd_hook = prev_ExecutorEnd;
 }
 
+/*
+ * shmem_startup hook: allocate or attach to shared memory
+ *
+ * Tracked plans are not saved across server restarts.
+ */
+static void
+ae_shmem_startup(void)
+{
+	bool		found;
+	HASHCTL		info;
+
+	if (prev_shmem_startup_hook)
+		prev_shmem_startup_hook();
+
+	/* reset in case this is a restart within the postmaster */
+	ae = NULL;
+	ae_hash = NULL;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	ae = ShmemInitStruct("auto_explain",
+						 sizeof(aeSharedState),
+						 &found);
+	if (!found)
+		ae->lock = LWLockAssign();
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(aePlanKey);
+	info.entrysize = sizeof(aePlanEntry);
+	ae_hash = ShmemInitHash("auto_explain plans",
+							auto_explain_max_tracked,
+							auto_explain_max_tracked,
+							&info,
+							HASH_ELEM | HASH_BLOBS);
+
+	LWLockRelease(AddinShmemInitLock);
+}
+
 /*
  * ExecutorStart hook: start up logging if needed
  */
 static void
 explain_ExecutorStart(QueryDesc *queryDesc, int eflags)
 {
+	/*
+	 * For rate sampling, randomly choose top-level statement.  Either all
+	 * nested statements will be explained or none will.
+	 */
+	if (nesting_level == 0 &&
+		(auto_explain_log_min_duration >= 0 || auto_explain_tracking()))
+		current_query_sampled = (auto_explain_sample_rate >= 1.0 ||
+								 random() < auto_explain_sample_rate *
+								 MAX_RANDOM_VALUE);
+
 	if (auto_explain_enabled())
 	{
-		/* Enable per-node instrumentation iff log_analyze is required. */
-		if (auto_explain_log_analyze && (eflags & EXEC_FLAG_EXPLAIN_ONLY) == 0)
+		/*
+		 * Enable per-node instrumentation iff log_analyze is required.  Plan
+		 * tracking needs only the total time, which is collected below.
+		 */
+		if (auto_explain_log_min_duration >= 0 && auto_explain_log_analyze &&
+			(eflags & EXEC_FLAG_EXPLAIN_ONLY) == 0)
 		{
 			if (auto_explain_log_timing)
 				queryDesc->instrument_options |= INSTRUMENT_TIMER;
@@ -290,9 +474,16 @@ explain_ExecutorEnd(QueryDesc *queryDesc)
 		 */
 		InstrEndLoop(queryDesc->totaltime);
 
-		/* Log plan if duration is exceeded. */
 		msec = queryDesc->totaltime->total * 1000.0;
-		if (msec >= auto_explain_log_min_duration)
+
+		/* Record the plan, unless this is just EXPLAIN */
+		if (auto_explain_tracking() &&
+			(queryDesc->estate->es_top_eflags & EXEC_FLAG_EXPLAIN_ONLY) == 0)
+			ae_store_plan(queryDesc, msec);
+
+		/* Log plan if duration is exceeded. */
+		if (auto_explain_log_min_duration >= 0 &&
+			msec >= auto_explain_log_min_duration)
 		{
 			ExplainState *es = NewExplainState();
 
@@ -341,3 +532,335 @@ explain_ExecutorEnd(QueryDesc *queryDesc)
 	else
 		standard_ExecutorEnd(queryDesc);
 }
+
+/*
+ * Record one execution of a statement's plan in the tracking table.
+ */
+static void
+ae_store_plan(QueryDesc *queryDesc, double msec)
+{
+	aePlanKey	key;
+	aePlanEntry *entry;
+	uint32		plan_hash;
+	TimestampTz now;
+
+	Assert(ae != NULL && ae_hash != NULL);
+
+	/*
+	 * Use the query ID computed by pg_stat_statements (or another module)
+	 * if there is one, so that the two can be joined.  Otherwise fall back
+	 * to a hash of the source text.
+	 */
+	key.dbid = MyDatabaseId;
+	key.queryid = queryDesc->plannedstmt->queryId;
+	if (key.queryid == 0)
+		key.queryid = hash_any((const unsigned char *) queryDesc->sourceText,
+							   strlen(queryDesc->sourceText));
+
+	plan_hash = ExplainPlanFingerprint(queryDesc->plannedstmt);
+	now = GetCurrentTimestamp();
+
+	/* Lookup the hash table entry with shared lock. */
+	LWLockAcquire(ae->lock, LW_SHARED);
+
+	entry = (aePlanEntry *) hash_search(ae_hash, &key, HASH_FIND, NULL);
+
+	/* Create new entry, if not present */
+	if (!entry)
+	{
+		/* Need exclusive lock to make a new hashtable entry - promote */
+		LWLockRelease(ae->lock);
+		LWLockAcquire(ae->lock, LW_EXCLUSIVE);
+
+		entry = ae_entry_alloc(&key);
+	}
+
+	/*
+	 * Grab the spinlock while updating the plans, to avoid needing exclusive
+	 * lock on the whole table.
+	 */
+	{
+		volatile aePlanEntry *e = (volatile aePlanEntry *) entry;
+		volatile aePlanStats *slot = NULL;
+		int			i;
+
+		SpinLockAcquire(&e->mutex);
+
+		/*
+		 * Look for this plan.  Failing that, take an unused slot, or else the
+		 * one that was used least recently.
+		 */
+		for (i = 0; i < AE_PLANS_PER_QUERY; i++)
+		{
+			volatile aePlanStats *p = &e->plans[i];
+
+			if (p->calls > 0 && p->plan_hash == plan_hash)
+			{
+				slot = p;
+				break;
+			}
+			if (slot == NULL ||
+				(slot->calls > 0 &&
+				 (p->calls == 0 || p->last_seen < slot->last_seen)))
+				slot = p;
+		}
+
+		if (slot->calls == 0 || slot->plan_hash != plan_hash)
+		{
+			slot->plan_hash = plan_hash;
+			slot->calls = 0;
+			slot->total_time = 0;
+			slot->min_time = msec;
+			slot->max_time = msec;
+			slot->first_seen = now;
+		}
+
+		slot->calls++;
+		slot->total_time += msec;
+		if (slot->min_time > msec)
+			slot->min_time = msec;
+		if (slot->max_time < msec)
+			slot->max_time = msec;
+		slot->last_seen = now;
+
+		SpinLockRelease(&e->mutex);
+	}
+
+	LWLockRelease(ae->lock);
+}
+
+/*
+ * Allocate a new hashtable entry, making room if needed.
+ * caller must hold an exclusive lock on ae->lock
+ *
+ * Note: it's not an error for the entry to already exist; someone else could
+ * have made it while we waited for the exclusive lock.
+ */
+static aePlanEntry *
+ae_entry_alloc(aePlanKey *key)
+{
+	aePlanEntry *entry;
+	bool		found;
+
+	/* Make space if needed */
+	while (hash_get_num_entries(ae_hash) >= auto_explain_max_tracked)
+		ae_entry_dealloc();
+
+	entry = (aePlanEntry *) hash_search(ae_hash, key, HASH_ENTER, &found);
+
+	if (!found)
+	{
+		memset(entry->plans, 0, sizeof(entry->plans));
+		SpinLockInit(&entry->mutex);
+	}
+
+	return entry;
+}
+
+/*
+ * Most recent time any plan of an entry was used
+ */
+static TimestampTz
+ae_entry_last_seen(aePlanEntry *entry)
+{
+	TimestampTz result = 0;
+	int			i;
+
+	for (i = 0; i < AE_PLANS_PER_QUERY; i++)
+	{
+		if (entry->plans[i].calls > 0 && entry->plans[i].last_seen > result)
+			result = entry->plans[i].last_seen;
+	}
+	return result;
+}
+
+/*
+ * qsort comparator for sorting into increasing last-use order
+ */
+static int
+entry_cmp(const void *lhs, const void *rhs)
+{
+	TimestampTz l = ae_entry_last_seen(*(aePlanEntry *const *) lhs);
+	TimestampTz r = ae_entry_last_seen(*(aePlanEntry *const *) rhs);
+
+	if (l < r)
+		return -1;
+	else if (l > r)
+		return +1;
+	else
+		return 0;
+}
+
+/*
+ * Deallocate least recently used entries.
+ * caller must hold an exclusive lock on ae->lock
+ */
+static void
+ae_entry_dealloc(void)
+{
+	HASH_SEQ_STATUS hash_seq;
+	aePlanEntry **entries;
+	aePlanEntry *entry;
+	int			nvictims;
+	int			i;
+
+	entries = palloc(hash_get_num_entries(ae_hash) * sizeof(aePlanEntry *));
+
+	i = 0;
+	hash_seq_init(&hash_seq, ae_hash);
+	while ((entry = hash_seq_search(&hash_seq)) != NULL)
+		entries[i++] = entry;
+
+	qsort(entries, i, sizeof(aePlanEntry *), entry_cmp);
+
+	nvictims = Max(10, i * AE_DEALLOC_PERCENT / 100);
+	nvictims = Min(nvictims, i);
+
+	for (i = 0; i < nvictims; i++)
+		hash_search(ae_hash, &entries[i]->key, HASH_REMOVE, NULL);
+
+	pfree(entries);
+}
+
+/*
+ * Retrieve the tracked plans.
+ */
+Datum
+auto_explain_plans(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	HASH_SEQ_STATUS hash_seq;
+	aePlanEntry *entry;
+
+	/* hash table must exist already */
+	if (!ae || !ae_hash)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("auto_explain must be loaded via shared_preload_libraries")));
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	/* Switch into long-lived context to construct returned data structures */
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+	if (tupdesc->natts != AUTO_EXPLAIN_PLANS_COLS)
+		elog(ERROR, "incorrect number of output arguments");
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	LWLockAcquire(ae->lock, LW_SHARED);
+
+	hash_seq_init(&hash_seq, ae_hash);
+	while ((entry = hash_seq_search(&hash_seq)) != NULL)
+	{
+		aePlanStats plans[AE_PLANS_PER_QUERY];
+		int			i;
+
+		/* copy the plans while holding the spinlock */
+		{
+			volatile aePlanEntry *e = (volatile aePlanEntry *) entry;
+
+			SpinLockAcquire(&e->mutex);
+			memcpy(plans, (aePlanStats *) e->plans, sizeof(plans));
+			SpinLockRelease(&e->mutex);
+		}
+
+		for (i = 0; i < AE_PLANS_PER_QUERY; i++)
+		{
+			Datum		values[AUTO_EXPLAIN_PLANS_COLS];
+			bool		nulls[AUTO_EXPLAIN_PLANS_COLS];
+			int			j = 0;
+
+			if (plans[i].calls == 0)
+				continue;
+
+			memset(values, 0, sizeof(values));
+			memset(nulls, 0, sizeof(nulls));
+
+			values[j++] = ObjectIdGetDatum(entry->key.dbid);
+			values[j++] = Int64GetDatumFast((int64) entry->key.queryid);
+			values[j++] = Int64GetDatumFast((int64) plans[i].plan_hash);
+			values[j++] = Int64GetDatumFast(plans[i].calls);
+			values[j++] = Float8GetDatumFast(plans[i].total_time);
+			values[j++] = Float8GetDatumFast(plans[i].min_time);
+			values[j++] = Float8GetDatumFast(plans[i].max_time);
+			values[j++] = Float8GetDatumFast(plans[i].total_time /
+											 plans[i].calls);
+			values[j++] = TimestampTzGetDatum(plans[i].first_seen);
+			values[j++] = TimestampTzGetDatum(plans[i].last_seen);
+
+			Assert(j == AUTO_EXPLAIN_PLANS_COLS);
+
+			tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+		}
+	}
+
+	LWLockRelease(ae->lock);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+
+/*
+ * Reset all tracked plans.
+ */
+Datum
+auto_explain_plans_reset(PG_FUNCTION_ARGS)
+{
+	HASH_SEQ_STATUS hash_seq;
+	aePlanEntry *entry;
+
+	if (!ae || !ae_hash)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("auto_explain must be loaded via shared_preload_libraries")));
+
+	LWLockAcquire(ae->lock, LW_EXCLUSIVE);
+
+	hash_seq_init(&hash_seq, ae_hash);
+	while ((entry = hash_seq_search(&hash_seq)) != NULL)
+		hash_search(ae_hash, &entry->key, HASH_REMOVE, NULL);
+
+	LWLockRelease(ae->lock);
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * Estimate shared memory space needed.
+ */
+static Size
+ae_memsize(void)
+{
+	Size		size;
+
+	size = MAXALIGN(sizeof(aeSharedState));
+	size = add_size(size, hash_estimate_size(auto_explain_max_tracked,
+											 sizeof(aePlanEntry)));
+
+	return size;
+}
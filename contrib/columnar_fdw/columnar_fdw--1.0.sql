@@ -0,0 +1,27 @@
+/* contrib/columnar_fdw/columnar_fdw--1.0.sql */
+
+-- complain if script is sourced in psql, rather than via CREATE EXTENSION
+\echo Use "CREATE EXTENSION columnar_fdw" to load this file. \quit
+
+CREATE FUNCTION columnar_fdw_handler()
+RETURNS fdw_handler
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION columnar_fdw_validator(text[], oid)
+RETURNS void
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+CREATE FOREIGN DATA WRAPPER columnar_fdw
+  HANDLER columnar_fdw_handler
+  VALIDATOR columnar_fdw_validator;
+
+-- removes the files of dropped tables
+CREATE FUNCTION columnar_fdw_drop_trigger()
+RETURNS event_trigger
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+CREATE EVENT TRIGGER columnar_fdw_drop ON sql_drop
+  EXECUTE PROCEDURE columnar_fdw_drop_trigger();
@@ -0,0 +1,861 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_fdw.c
+ *		  Foreign-data wrapper for tables stored column by column.
+ *
+ * This file holds the FDW callbacks; the file format is handled by
+ * columnar_writer.c and columnar_reader.c, see columnar_fdw.h.
+ *
+ * Copyright (c) 2015, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		  contrib/columnar_fdw/columnar_fdw.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "access/reloptions.h"
+#include "access/sysattr.h"
+#include "access/xact.h"
+#include "catalog/pg_foreign_table.h"
+#include "commands/defrem.h"
+#include "commands/event_trigger.h"
+#include "commands/explain.h"
+#include "executor/spi.h"
+#include "foreign/fdwapi.h"
+#include "foreign/foreign.h"
+#include "miscadmin.h"
+#include "optimizer/cost.h"
+#include "optimizer/pathnode.h"
+#include "optimizer/planmain.h"
+#include "optimizer/restrictinfo.h"
+#include "optimizer/var.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+
+#include "columnar_fdw.h"
+
+PG_MODULE_MAGIC;
+
+/*
+ * Describes the valid options for objects that use this wrapper.
+ */
+struct ColumnarFdwOption
+{
+	const char *optname;
+	Oid			optcontext;		/* Oid of catalog in which option may appear */
+};
+
+static const struct ColumnarFdwOption valid_options[] = {
+	{"filename", ForeignTableRelationId},
+	{"stripe_rows", ForeignTableRelationId},
+	{"compression", ForeignTableRelationId},
+
+	/* Sentinel */
+	{NULL, InvalidOid}
+};
+
+/*
+ * FDW-specific information for RelOptInfo.fdw_private.
+ */
+typedef struct ColumnarPlanState
+{
+	ColumnarOptions options;
+	Bitmapset  *attrs_needed;	/* attributes the query uses */
+	BlockNumber pages;			/* size of those attributes' data */
+	double		ntuples;		/* number of rows in the file */
+} ColumnarPlanState;
+
+/*
+ * FDW-specific information for ForeignScanState.fdw_state.
+ */
+typedef struct ColumnarScanState
+{
+	char	   *filename;
+	ColumnarReadState *reader;
+} ColumnarScanState;
+
+/* A file to remove when the transaction that dropped its table commits */
+typedef struct PendingUnlink
+{
+	char		path[MAXPGPATH];
+	int			nestlevel;		/* transaction nesting level of the drop */
+} PendingUnlink;
+
+static List *pending_unlinks = NIL;
+static bool xact_callbacks_registered = false;
+
+/*
+ * SQL functions
+ */
+PG_FUNCTION_INFO_V1(columnar_fdw_handler);
+PG_FUNCTION_INFO_V1(columnar_fdw_validator);
+PG_FUNCTION_INFO_V1(columnar_fdw_drop_trigger);
+
+/*
+ * FDW callback routines
+ */
+static void columnarGetForeignRelSize(PlannerInfo *root,
+						  RelOptInfo *baserel,
+						  Oid foreigntableid);
+static void columnarGetForeignPaths(PlannerInfo *root,
+						RelOptInfo *baserel,
+						Oid foreigntableid);
+static ForeignScan *columnarGetForeignPlan(PlannerInfo *root,
+					   RelOptInfo *baserel,
+					   Oid foreigntableid,
+					   ForeignPath *best_path,
+					   List *tlist,
+					   List *scan_clauses);
+static void columnarExplainForeignScan(ForeignScanState *node,
+						   ExplainState *es);
+static void columnarBeginForeignScan(ForeignScanState *node, int eflags);
+static TupleTableSlot *columnarIterateForeignScan(ForeignScanState *node);
+static void columnarReScanForeignScan(ForeignScanState *node);
+static void columnarEndForeignScan(ForeignScanState *node);
+static int	columnarIsForeignRelUpdatable(Relation rel);
+static void columnarBeginForeignModify(ModifyTableState *mtstate,
+						   ResultRelInfo *rinfo,
+						   List *fdw_private,
+						   int subplan_index,
+						   int eflags);
+static TupleTableSlot *columnarExecForeignInsert(EState *estate,
+						  ResultRelInfo *rinfo,
+						  TupleTableSlot *slot,
+						  TupleTableSlot *planSlot);
+static void columnarEndForeignModify(EState *estate,
+						 ResultRelInfo *rinfo);
+static void columnarBeginForeignInsert(EState *estate,
+						   ResultRelInfo *rinfo);
+static int columnarExecForeignBatchInsert(EState *estate,
+							   ResultRelInfo *rinfo,
+							   TupleTableSlot **slots,
+							   int nslots);
+
+/*
+ * Helper functions
+ */
+static bool is_valid_option(const char *option, Oid context);
+static int	parse_stripe_rows(DefElem *def);
+static bool parse_compression(DefElem *def);
+static char *default_filename(Oid relid);
+static Bitmapset *get_attrs_needed(RelOptInfo *baserel, Oid foreigntableid);
+static ColumnarWriteState *begin_insert(Relation rel);
+static void unlink_at_commit(const char *path);
+static void columnar_xact_callback(XactEvent event, void *arg);
+static void columnar_subxact_callback(SubXactEvent event,
+						  SubTransactionId mySubid,
+						  SubTransactionId parentSubid,
+						  void *arg);
+
+
+/*
+ * Foreign-data wrapper handler function: return a struct with pointers
+ * to my callback routines.
+ */
+Datum
+columnar_fdw_handler(PG_FUNCTION_ARGS)
+{
+	FdwRoutine *fdwroutine = makeNode(FdwRoutine);
+
+	fdwroutine->GetForeignRelSize = columnarGetForeignRelSize;
+	fdwroutine->GetForeignPaths = columnarGetForeignPaths;
+	fdwroutine->GetForeignPlan = columnarGetForeignPlan;
+	fdwroutine->ExplainForeignScan = columnarExplainForeignScan;
+	fdwroutine->BeginForeignScan = columnarBeginForeignScan;
+	fdwroutine->IterateForeignScan = columnarIterateForeignScan;
+	fdwroutine->ReScanForeignScan = columnarReScanForeignScan;
+	fdwroutine->EndForeignScan = columnarEndForeignScan;
+
+	fdwroutine->IsForeignRelUpdatable = columnarIsForeignRelUpdatable;
+	fdwroutine->BeginForeignModify = columnarBeginForeignModify;
+	fdwroutine->ExecForeignInsert = columnarExecForeignInsert;
+	fdwroutine->EndForeignModify = columnarEndForeignModify;
+
+	fdwroutine->BeginForeignInsert = columnarBeginForeignInsert;
+	fdwroutine->ExecForeignBatchInsert = columnarExecForeignBatchInsert;
+	fdwroutine->EndForeignInsert = columnarEndForeignModify;
+
+	PG_RETURN_POINTER(fdwroutine);
+}
+
+/*
+ * Validate the generic options given to a FOREIGN DATA WRAPPER, SERVER,
+ * USER MAPPING or FOREIGN TABLE that uses columnar_fdw.
+ *
+ * Raise an ERROR if the option or its value is considered invalid.
+ */
+Datum
+columnar_fdw_validator(PG_FUNCTION_ARGS)
+{
+	List	   *options_list = untransformRelOptions(PG_GETARG_DATUM(0));
+	Oid			catalog = PG_GETARG_OID(1);
+	ListCell   *cell;
+
+	foreach(cell, options_list)
+	{
+		DefElem    *def = (DefElem *) lfirst(cell);
+
+		if (!is_valid_option(def->defname, catalog))
+		{
+			const struct ColumnarFdwOption *opt;
+			StringInfoData buf;
+
+			/*
+			 * Unknown option specified, complain about it. Provide a hint
+			 * with list of valid options for the object.
+			 */
+			initStringInfo(&buf);
+			for (opt = valid_options; opt->optname; opt++)
+			{
+				if (catalog == opt->optcontext)
+					appendStringInfo(&buf, "%s%s", (buf.len > 0) ? ", " : "",
+									 opt->optname);
+			}
+
+			ereport(ERROR,
+					(errcode(ERRCODE_FDW_INVALID_OPTION_NAME),
+					 errmsg("invalid option \"%s\"", def->defname),
+					 buf.len > 0
+					 ? errhint("Valid options in this context are: %s",
+							   buf.data)
+				  : errhint("There are no valid options in this context.")));
+		}
+
+		/*
+		 * Like file_fdw, only a superuser may choose which file a table
+		 * reads and writes.  Other tables get a file of their own under the
+		 * data directory.
+		 */
+		if (strcmp(def->defname, "filename") == 0)
+		{
+			if (!superuser())
+				ereport(ERROR,
+						(errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+						 errmsg("only superuser can set the filename of a columnar_fdw foreign table")));
+			(void) defGetString(def);
+		}
+		else if (strcmp(def->defname, "stripe_rows") == 0)
+			(void) parse_stripe_rows(def);
+		else if (strcmp(def->defname, "compression") == 0)
+			(void) parse_compression(def);
+	}
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * Event trigger function, fired for sql_drop, that removes the files of
+ * dropped tables once the dropping transaction commits.
+ *
+ * pg_class no longer knows whether a dropped relation was a columnar table,
+ * but only columnar_fdw creates files at the default location, so we remove
+ * any file found there.  Files named by a filename option are left alone,
+ * as file_fdw does.
+ */
+Datum
+columnar_fdw_drop_trigger(PG_FUNCTION_ARGS)
+{
+	int			ret;
+	uint64		i;
+
+	if (!CALLED_AS_EVENT_TRIGGER(fcinfo))
+		elog(ERROR, "not fired by event trigger manager");
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "SPI_connect failed");
+
+	ret = SPI_execute("SELECT objid FROM pg_catalog.pg_event_trigger_dropped_objects()"
+					  " WHERE classid = 'pg_catalog.pg_class'::pg_catalog.regclass"
+					  " AND objsubid = 0", true, 0);
+	if (ret != SPI_OK_SELECT)
+		elog(ERROR, "SPI_execute failed: error code %d", ret);
+
+	for (i = 0; i < SPI_processed; i++)
+	{
+		bool		isnull;
+		Oid			relid;
+		char	   *path;
+		struct stat st;
+
+		relid = DatumGetObjectId(SPI_getbinval(SPI_tuptable->vals[i],
+											   SPI_tuptable->tupdesc,
+											   1, &isnull));
+		path = default_filename(relid);
+		if (stat(path, &st) == 0)
+			unlink_at_commit(path);
+	}
+
+	SPI_finish();
+
+	PG_RETURN_NULL();
+}
+
+/*
+ * Check if the provided option is one of the valid options.
+ * context is the Oid of the catalog holding the object the option is for.
+ */
+static bool
+is_valid_option(const char *option, Oid context)
+{
+	const struct ColumnarFdwOption *opt;
+
+	for (opt = valid_options; opt->optname; opt++)
+	{
+		if (context == opt->optcontext && strcmp(opt->optname, option) == 0)
+			return true;
+	}
+	return false;
+}
+
+static int
+parse_stripe_rows(DefElem *def)
+{
+	char	   *value = defGetString(def);
+	char	   *endp;
+	long		result;
+
+	errno = 0;
+	result = strtol(value, &endp, 10);
+	if (errno != 0 || endp == value || *endp != '\0' ||
+		result < 1 || result > MAX_STRIPE_ROWS)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("%s requires an integer value between 1 and %d",
+						def->defname, MAX_STRIPE_ROWS)));
+	return (int) result;
+}
+
+static bool
+parse_compression(DefElem *def)
+{
+	char	   *value = defGetString(def);
+
+	if (strcmp(value, "pglz") == 0)
+		return true;
+	if (strcmp(value, "none") == 0)
+		return false;
+	ereport(ERROR,
+			(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			 errmsg("invalid compression method \"%s\"", value),
+			 errhint("Valid values are \"pglz\" and \"none\".")));
+	return false;				/* keep compiler quiet */
+}
+
+/*
+ * Path of the file of a table without a filename option, relative to the
+ * data directory.
+ */
+static char *
+default_filename(Oid relid)
+{
+	return psprintf("%s/%u/%u", COLUMNAR_DIRECTORY, MyDatabaseId, relid);
+}
+
+/*
+ * Fetch the options for a columnar_fdw foreign table, filling in defaults.
+ */
+void
+columnar_get_options(Oid foreigntableid, ColumnarOptions *options)
+{
+	ForeignTable *table = GetForeignTable(foreigntableid);
+	ListCell   *lc;
+
+	options->filename = NULL;
+	options->stripe_rows = DEFAULT_STRIPE_ROWS;
+	options->compress = true;
+
+	foreach(lc, table->options)
+	{
+		DefElem    *def = (DefElem *) lfirst(lc);
+
+		if (strcmp(def->defname, "filename") == 0)
+			options->filename = defGetString(def);
+		else if (strcmp(def->defname, "stripe_rows") == 0)
+			options->stripe_rows = parse_stripe_rows(def);
+		else if (strcmp(def->defname, "compression") == 0)
+			options->compress = parse_compression(def);
+	}
+
+	if (options->filename == NULL)
+		options->filename = default_filename(foreigntableid);
+}
+
+/*
+ * Collect the attributes needed for joins, final output, or restriction
+ * clauses.  A whole-row reference needs them all.
+ */
+static Bitmapset *
+get_attrs_needed(RelOptInfo *baserel, Oid foreigntableid)
+{
+	Bitmapset  *attrs_used = NULL;
+	Bitmapset  *result = NULL;
+	ListCell   *lc;
+	int			attnum;
+
+	pull_varattnos((Node *) baserel->reltargetlist, baserel->relid,
+				   &attrs_used);
+	foreach(lc, baserel->baserestrictinfo)
+	{
+		RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+
+		pull_varattnos((Node *) rinfo->clause, baserel->relid,
+					   &attrs_used);
+	}
+
+	attnum = -1;
+	while ((attnum = bms_next_member(attrs_used, attnum)) >= 0)
+	{
+		/* Adjust for system attributes. */
+		int			attno = attnum + FirstLowInvalidHeapAttributeNumber;
+
+		if (attno == 0)
+		{
+			/* whole-row reference */
+			Relation	rel = heap_open(foreigntableid, AccessShareLock);
+			int			i;
+
+			for (i = 1; i <= RelationGetNumberOfAttributes(rel); i++)
+				result = bms_add_member(result, i);
+			heap_close(rel, AccessShareLock);
+			break;
+		}
+		if (attno > 0)
+			result = bms_add_member(result, attno);
+	}
+
+	return result;
+}
+
+/*
+ * columnarGetForeignRelSize
+ *		Obtain relation size estimates for a foreign table
+ *
+ * The stripe headers tell us exactly how many rows the file holds, and how
+ * much data the columns we need take up.
+ */
+static void
+columnarGetForeignRelSize(PlannerInfo *root,
+						  RelOptInfo *baserel,
+						  Oid foreigntableid)
+{
+	ColumnarPlanState *fdw_private;
+	double		nbytes;
+
+	fdw_private = (ColumnarPlanState *) palloc0(sizeof(ColumnarPlanState));
+	columnar_get_options(foreigntableid, &fdw_private->options);
+	fdw_private->attrs_needed = get_attrs_needed(baserel, foreigntableid);
+	columnar_table_size(fdw_private->options.filename,
+						fdw_private->attrs_needed,
+						&fdw_private->ntuples, &nbytes);
+	fdw_private->pages = (BlockNumber) ceil(nbytes / BLCKSZ);
+	baserel->fdw_private = (void *) fdw_private;
+
+	baserel->rows = clamp_row_est(fdw_private->ntuples *
+								  clauselist_selectivity(root,
+												 baserel->baserestrictinfo,
+														 0,
+														 JOIN_INNER,
+														 NULL));
+}
+
+/*
+ * columnarGetForeignPaths
+ *		Create possible access paths for a scan on the foreign table
+ *
+ *		There's only one: read the file from start to end.
+ */
+static void
+columnarGetForeignPaths(PlannerInfo *root,
+						RelOptInfo *baserel,
+						Oid foreigntableid)
+{
+	ColumnarPlanState *fdw_private = (ColumnarPlanState *) baserel->fdw_private;
+	Cost		startup_cost;
+	Cost		run_cost;
+	Cost		cpu_per_tuple;
+
+	/*
+	 * Like cost_seqscan(), except that only the needed columns are read.
+	 * Stripes that can be skipped aren't accounted for.
+	 */
+	startup_cost = baserel->baserestrictcost.startup;
+	cpu_per_tuple = cpu_tuple_cost + baserel->baserestrictcost.per_tuple;
+	run_cost = seq_page_cost * fdw_private->pages +
+		cpu_per_tuple * fdw_private->ntuples;
+
+	add_path(baserel, (Path *)
+			 create_foreignscan_path(root, baserel,
+									 baserel->rows,
+									 startup_cost,
+									 startup_cost + run_cost,
+									 NIL,		/* no pathkeys */
+									 NULL,		/* no outer rel either */
+									 NIL));		/* no fdw_private data */
+}
+
+/*
+ * columnarGetForeignPlan
+ *		Create a ForeignScan plan node for scanning the foreign table
+ *
+ * The attribute numbers the scan needs are passed on in fdw_private.
+ */
+static ForeignScan *
+columnarGetForeignPlan(PlannerInfo *root,
+					   RelOptInfo *baserel,
+					   Oid foreigntableid,
+					   ForeignPath *best_path,
+					   List *tlist,
+					   List *scan_clauses)
+{
+	ColumnarPlanState *fdw_private = (ColumnarPlanState *) baserel->fdw_private;
+	List	   *attnums = NIL;
+	int			attnum;
+
+	attnum = -1;
+	while ((attnum = bms_next_member(fdw_private->attrs_needed, attnum)) >= 0)
+		attnums = lappend_int(attnums, attnum);
+
+	/*
+	 * The executor checks all the quals.  We only use them to skip stripes,
+	 * and find them in the plan node's qual list for that.
+	 */
+	scan_clauses = extract_actual_clauses(scan_clauses, false);
+
+	return make_foreignscan(tlist,
+							scan_clauses,
+							baserel->relid,
+							NIL,	/* no expressions to evaluate */
+							attnums,
+							NIL /* no custom tlist */ );
+}
+
+/*
+ * columnarExplainForeignScan
+ *		Produce extra output for EXPLAIN
+ */
+static void
+columnarExplainForeignScan(ForeignScanState *node, ExplainState *es)
+{
+	ColumnarScanState *fsstate = (ColumnarScanState *) node->fdw_state;
+
+	if (es->verbose)
+	{
+		ColumnarOptions options;
+
+		columnar_get_options(RelationGetRelid(node->ss.ss_currentRelation),
+							 &options);
+		ExplainPropertyText("Columnar File", options.filename, es);
+	}
+
+	if (es->analyze && fsstate != NULL)
+	{
+		long		stripes_read;
+		long		stripes_skipped;
+
+		columnar_read_counts(fsstate->reader, &stripes_read, &stripes_skipped);
+		ExplainPropertyLong("Stripes Read", stripes_read, es);
+		ExplainPropertyLong("Stripes Skipped", stripes_skipped, es);
+	}
+}
+
+/*
+ * columnarBeginForeignScan
+ *		Open the file and read its stripe headers
+ */
+static void
+columnarBeginForeignScan(ForeignScanState *node, int eflags)
+{
+	ForeignScan *plan = (ForeignScan *) node->ss.ps.plan;
+	Relation	rel = node->ss.ss_currentRelation;
+	ColumnarScanState *fsstate;
+	ColumnarOptions options;
+	Bitmapset  *attrs_needed = NULL;
+	ListCell   *lc;
+
+	/*
+	 * Do nothing in EXPLAIN (no ANALYZE) case.  node->fdw_state stays NULL.
+	 */
+	if (eflags & EXEC_FLAG_EXPLAIN_ONLY)
+		return;
+
+	columnar_get_options(RelationGetRelid(rel), &options);
+
+	foreach(lc, plan->fdw_private)
+		attrs_needed = bms_add_member(attrs_needed, lfirst_int(lc));
+
+	fsstate = (ColumnarScanState *) palloc(sizeof(ColumnarScanState));
+	fsstate->filename = options.filename;
+	fsstate->reader = columnar_begin_read(options.filename,
+										  RelationGetDescr(rel),
+										  attrs_needed,
+										  plan->scan.plan.qual,
+										  plan->scan.scanrelid);
+
+	node->fdw_state = (void *) fsstate;
+}
+
+/*
+ * columnarIterateForeignScan
+ *		Return the next row as a virtual tuple
+ */
+static TupleTableSlot *
+columnarIterateForeignScan(ForeignScanState *node)
+{
+	ColumnarScanState *fsstate = (ColumnarScanState *) node->fdw_state;
+	TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
+
+	ExecClearTuple(slot);
+	if (columnar_read_row(fsstate->reader,
+						  slot->tts_values, slot->tts_isnull))
+		ExecStoreVirtualTuple(slot);
+
+	return slot;
+}
+
+/*
+ * columnarReScanForeignScan
+ *		Rescan table, possibly with new parameters
+ */
+static void
+columnarReScanForeignScan(ForeignScanState *node)
+{
+	ColumnarScanState *fsstate = (ColumnarScanState *) node->fdw_state;
+
+	columnar_rescan(fsstate->reader);
+}
+
+/*
+ * columnarEndForeignScan
+ *		Finish scanning foreign table and dispose objects used for this scan
+ */
+static void
+columnarEndForeignScan(ForeignScanState *node)
+{
+	ColumnarScanState *fsstate = (ColumnarScanState *) node->fdw_state;
+
+	/* if fsstate is NULL, we are in EXPLAIN; nothing to do */
+	if (fsstate)
+		columnar_end_read(fsstate->reader);
+}
+
+/*
+ * columnarIsForeignRelUpdatable
+ *		Rows can be appended, but not updated or deleted
+ */
+static int
+columnarIsForeignRelUpdatable(Relation rel)
+{
+	return (1 << CMD_INSERT);
+}
+
+/*
+ * columnarBeginForeignModify
+ *		Begin an INSERT into a foreign table
+ */
+static void
+columnarBeginForeignModify(ModifyTableState *mtstate,
+						   ResultRelInfo *rinfo,
+						   List *fdw_private,
+						   int subplan_index,
+						   int eflags)
+{
+	/*
+	 * Do nothing in EXPLAIN (no ANALYZE) case.  rinfo->ri_FdwState stays
+	 * NULL.
+	 */
+	if (eflags & EXEC_FLAG_EXPLAIN_ONLY)
+		return;
+
+	rinfo->ri_FdwState = begin_insert(rinfo->ri_RelationDesc);
+}
+
+/*
+ * columnarExecForeignInsert
+ *		Add one row; it's written out with the rest of its stripe
+ */
+static TupleTableSlot *
+columnarExecForeignInsert(EState *estate,
+						  ResultRelInfo *rinfo,
+						  TupleTableSlot *slot,
+						  TupleTableSlot *planSlot)
+{
+	ColumnarWriteState *writer = (ColumnarWriteState *) rinfo->ri_FdwState;
+
+	slot_getallattrs(slot);
+	columnar_write_row(writer, slot->tts_values, slot->tts_isnull);
+
+	return slot;
+}
+
+/*
+ * columnarEndForeignModify
+ *		Write out the last stripe of an INSERT or COPY FROM
+ */
+static void
+columnarEndForeignModify(EState *estate,
+						 ResultRelInfo *rinfo)
+{
+	ColumnarWriteState *writer = (ColumnarWriteState *) rinfo->ri_FdwState;
+
+	/* if writer is NULL, we are in EXPLAIN; nothing to do */
+	if (writer)
+		columnar_end_write(writer);
+}
+
+/*
+ * columnarBeginForeignInsert
+ *		Begin a COPY FROM into a foreign table
+ */
+static void
+columnarBeginForeignInsert(EState *estate,
+						   ResultRelInfo *rinfo)
+{
+	rinfo->ri_FdwState = begin_insert(rinfo->ri_RelationDesc);
+}
+
+/*
+ * columnarExecForeignBatchInsert
+ *		Add a batch of rows from COPY FROM
+ */
+static int
+columnarExecForeignBatchInsert(EState *estate,
+							   ResultRelInfo *rinfo,
+							   TupleTableSlot **slots,
+							   int nslots)
+{
+	ColumnarWriteState *writer = (ColumnarWriteState *) rinfo->ri_FdwState;
+	int			i;
+
+	for (i = 0; i < nslots; i++)
+	{
+		slot_getallattrs(slots[i]);
+		columnar_write_row(writer, slots[i]->tts_values,
+						   slots[i]->tts_isnull);
+	}
+
+	return nslots;
+}
+
+/*
+ * Set up to write to a table, creating the directory for its file if it
+ * lives at the default location.
+ */
+static ColumnarWriteState *
+begin_insert(Relation rel)
+{
+	ColumnarOptions options;
+
+	columnar_get_options(RelationGetRelid(rel), &options);
+
+	if (strncmp(options.filename, COLUMNAR_DIRECTORY "/",
+				strlen(COLUMNAR_DIRECTORY "/")) == 0)
+	{
+		char	   *dir = pstrdup(options.filename);
+
+		*strrchr(dir, '/') = '\0';
+		if (pg_mkdir_p(dir, S_IRWXU) != 0)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not create directory \"%s\": %m", dir)));
+		pfree(dir);
+	}
+
+	return columnar_begin_write(options.filename, RelationGetDescr(rel),
+								&options);
+}
+
+/*
+ * Arrange for a file to be removed if the current (sub)transaction commits.
+ */
+static void
+unlink_at_commit(const char *path)
+{
+	PendingUnlink *pending;
+	MemoryContext oldcxt;
+
+	if (!xact_callbacks_registered)
+	{
+		RegisterXactCallback(columnar_xact_callback, NULL);
+		RegisterSubXactCallback(columnar_subxact_callback, NULL);
+		xact_callbacks_registered = true;
+	}
+
+	oldcxt = MemoryContextSwitchTo(TopMemoryContext);
+	pending = (PendingUnlink *) palloc(sizeof(PendingUnlink));
+	strlcpy(pending->path, path, MAXPGPATH);
+	pending->nestlevel = GetCurrentTransactionNestLevel();
+	pending_unlinks = lcons(pending, pending_unlinks);
+	MemoryContextSwitchTo(oldcxt);
+}
+
+static void
+columnar_xact_callback(XactEvent event, void *arg)
+{
+	ListCell   *lc;
+
+	switch (event)
+	{
+		case XACT_EVENT_PRE_PREPARE:
+			if (pending_unlinks != NIL)
+				ereport(ERROR,
+						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						 errmsg("cannot prepare a transaction that has dropped a columnar_fdw table")));
+			break;
+		case XACT_EVENT_COMMIT:
+			foreach(lc, pending_unlinks)
+			{
+				PendingUnlink *pending = (PendingUnlink *) lfirst(lc);
+
+				if (unlink(pending->path) < 0 && errno != ENOENT)
+					ereport(WARNING,
+							(errcode_for_file_access(),
+							 errmsg("could not remove file \"%s\": %m",
+									pending->path)));
+			}
+			/* FALL THRU */
+		case XACT_EVENT_ABORT:
+			list_free_deep(pending_unlinks);
+			pending_unlinks = NIL;
+			break;
+		default:
+			break;
+	}
+}
+
+static void
+columnar_subxact_callback(SubXactEvent event, SubTransactionId mySubid,
+						  SubTransactionId parentSubid, void *arg)
+{
+	int			curlevel = GetCurrentTransactionNestLevel();
+	List	   *keep = NIL;
+	ListCell   *lc;
+	MemoryContext oldcxt;
+
+	if (event != SUBXACT_EVENT_COMMIT_SUB && event != SUBXACT_EVENT_ABORT_SUB)
+		return;
+
+	oldcxt = MemoryContextSwitchTo(TopMemoryContext);
+	foreach(lc, pending_unlinks)
+	{
+		PendingUnlink *pending = (PendingUnlink *) lfirst(lc);
+
+		if (pending->nestlevel < curlevel)
+			keep = lappend(keep, pending);
+		else if (event == SUBXACT_EVENT_COMMIT_SUB)
+		{
+			/* the parent takes over the drop */
+			pending->nestlevel = curlevel - 1;
+			keep = lappend(keep, pending);
+		}
+		else
+			pfree(pending);
+	}
+	list_free(pending_unlinks);
+	pending_unlinks = keep;
+	MemoryContextSwitchTo(oldcxt);
+}
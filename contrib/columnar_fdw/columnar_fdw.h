@@ -0,0 +1,117 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_fdw.h
+ *		  Declarations for the columnar_fdw storage format.
+ *
+ * A columnar table is a single file holding a sequence of stripes.  Each
+ * stripe is written in one piece and stores some number of rows, column by
+ * column.  It starts with a header, followed by a directory with one entry
+ * per column, the minimum and maximum values of the columns, and finally
+ * the data of each column, compressed separately.
+ *
+ * A column's uncompressed data is a null bitmap (if the column has any
+ * nulls in the stripe), padded to MAXALIGN, followed by the non-null values
+ * in the same form as in a heap tuple, each aligned as its type requires.
+ * Varlena values are always stored with a 4-byte header and uncompressed,
+ * since the column data is compressed as a whole anyway.
+ *
+ * Everything is written in native byte order, so like the rest of the data
+ * directory, the files can't be moved to a machine of another architecture.
+ *
+ * Copyright (c) 2015, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		  contrib/columnar_fdw/columnar_fdw.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef COLUMNAR_FDW_H
+#define COLUMNAR_FDW_H
+
+#include "access/tupdesc.h"
+#include "fmgr.h"
+#include "lib/stringinfo.h"
+#include "nodes/bitmapset.h"
+#include "nodes/pg_list.h"
+
+#define COLUMNAR_MAGIC			0x436F6C53		/* "ColS" */
+#define COLUMNAR_VERSION		1
+
+/* Default and limits of the stripe_rows option */
+#define DEFAULT_STRIPE_ROWS		150000
+#define MAX_STRIPE_ROWS			10000000
+
+/*
+ * A stripe is also finished early once its uncompressed data reaches this
+ * size, to keep every column's data well below MaxAllocSize.
+ */
+#define MAX_STRIPE_BYTES		((Size) 256 * 1024 * 1024)
+
+/* Where tables without a filename option keep their data, under DataDir */
+#define COLUMNAR_DIRECTORY		"columnar_fdw"
+
+typedef struct StripeHeader
+{
+	uint32		magic;			/* COLUMNAR_MAGIC */
+	uint32		version;		/* COLUMNAR_VERSION */
+	uint32		nrows;			/* number of rows in the stripe */
+	uint32		ncolumns;		/* number of ColumnEntry items */
+	uint32		headerlen;		/* length of header, directory and min/max */
+	uint64		datalen;		/* length of the column data that follows */
+} StripeHeader;
+
+/* ColumnEntry.flags */
+#define COLUMN_HAS_NULLS		0x0001	/* data starts with a null bitmap */
+#define COLUMN_HAS_MINMAX		0x0002	/* min/max values are present */
+#define COLUMN_COMPRESSED		0x0004	/* data is pglz-compressed */
+
+typedef struct ColumnEntry
+{
+	Oid			typid;			/* type of the column, or InvalidOid if it
+								 * was dropped when the stripe was written */
+	uint32		flags;
+	uint64		offset;			/* start of data, from end of header */
+	uint32		rawlen;			/* length of data when uncompressed */
+	uint32		storedlen;		/* length of data in the file */
+	uint32		minlen;			/* length of min value after directory */
+	uint32		maxlen;			/* length of max value after min value */
+} ColumnEntry;
+
+/* Options of a columnar foreign table */
+typedef struct ColumnarOptions
+{
+	char	   *filename;		/* path of the data file */
+	int			stripe_rows;	/* rows per stripe */
+	bool		compress;		/* compress column data? */
+} ColumnarOptions;
+
+typedef struct ColumnarWriteState ColumnarWriteState;
+typedef struct ColumnarReadState ColumnarReadState;
+
+/* columnar_fdw.c */
+extern void columnar_get_options(Oid foreigntableid, ColumnarOptions *options);
+
+/* columnar_writer.c */
+extern ColumnarWriteState *columnar_begin_write(const char *filename,
+					 TupleDesc tupdesc,
+					 const ColumnarOptions *options);
+extern void columnar_write_row(ColumnarWriteState *state,
+				   Datum *values, bool *isnull);
+extern void columnar_end_write(ColumnarWriteState *state);
+extern void columnar_serialize_datum(StringInfo buf, Datum value,
+						 Form_pg_attribute att);
+
+/* columnar_reader.c */
+extern ColumnarReadState *columnar_begin_read(const char *filename,
+					TupleDesc tupdesc, Bitmapset *attrs_needed,
+					List *quals, Index scanrelid);
+extern bool columnar_read_row(ColumnarReadState *state,
+				  Datum *values, bool *isnull);
+extern void columnar_rescan(ColumnarReadState *state);
+extern void columnar_end_read(ColumnarReadState *state);
+extern void columnar_read_counts(ColumnarReadState *state,
+					 long *stripes_read, long *stripes_skipped);
+extern void columnar_table_size(const char *filename, Bitmapset *attrs_needed,
+					double *nrows, double *nbytes);
+
+#endif   /* COLUMNAR_FDW_H */
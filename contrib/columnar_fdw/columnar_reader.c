@@ -0,0 +1,623 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_reader.c
+ *		  Reading rows back from a columnar_fdw data file.
+ *
+ * When a scan starts, we read the headers of all the stripes in the file.
+ * Only the columns the query needs are read and decompressed from each
+ * stripe.  A stripe is skipped altogether if a qual of the form
+ * "column op constant", with op a btree comparison operator, can't be true
+ * for any value between the column's minimum and maximum in the stripe.
+ *
+ * Copyright (c) 2015, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		  contrib/columnar_fdw/columnar_reader.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "access/htup_details.h"
+#include "access/nbtree.h"
+#include "access/tupmacs.h"
+#include "common/pg_lzcompress.h"
+#include "nodes/primnodes.h"
+#include "storage/fd.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/typcache.h"
+
+#include "columnar_fdw.h"
+
+/* What we know about one stripe of the file */
+typedef struct StripeInfo
+{
+	off_t		dataoffset;		/* file offset of the column data */
+	uint32		nrows;
+	uint32		ncolumns;
+	ColumnEntry *entries;		/* column directory */
+	char	   *minmax;			/* min/max values, as stored */
+} StripeInfo;
+
+/* A column of the stripe being returned */
+typedef struct ColumnReader
+{
+	char	   *data;			/* uncompressed data, or NULL if not read */
+	bits8	   *nullbitmap;		/* null bitmap, or NULL if no nulls */
+	char	   *values;			/* start of the values */
+	long		off;			/* offset of the next value */
+} ColumnReader;
+
+/* A qual "column op constant" that may let us skip stripes */
+typedef struct StripeBound
+{
+	AttrNumber	attnum;
+	int			strategy;		/* btree strategy number of op */
+	Datum		value;			/* the constant */
+	FmgrInfo   *cmpfn;			/* btree comparison function of the type */
+	Oid			collation;
+} StripeBound;
+
+struct ColumnarReadState
+{
+	char	   *filename;
+	TupleDesc	tupdesc;
+	FILE	   *file;
+	StripeInfo *stripes;
+	int			nstripes;
+	int		   *attnums;		/* needed attributes, 0-based */
+	int			nattnums;
+	List	   *bounds;			/* list of StripeBound */
+	int			curstripe;		/* index of current stripe, or -1 */
+	uint32		currow;			/* next row to return from it */
+	ColumnReader *columns;		/* one per attribute */
+	MemoryContext stripecxt;	/* holds data of the current stripe */
+	long		stripes_read;
+	long		stripes_skipped;
+};
+
+static StripeInfo *read_stripe_infos(FILE *file, const char *filename,
+				  int *nstripes);
+static List *make_stripe_bounds(List *quals, TupleDesc tupdesc,
+				   Index scanrelid);
+static bool stripe_refuted(ColumnarReadState *state, StripeInfo *stripe);
+static void load_stripe(ColumnarReadState *state, StripeInfo *stripe);
+static void read_file_range(ColumnarReadState *state, off_t offset,
+				char *buf, Size len);
+static Datum deserialize_datum(char *ptr, Form_pg_attribute att);
+
+
+/*
+ * Prepare to read a columnar file.  Only the attributes (numbered from 1)
+ * in attrs_needed are returned; the others read as null.  quals are the
+ * scan's qual expressions, in implicit-AND form, whose Vars refer to
+ * scanrelid.  They're only used for skipping stripes, and the caller must
+ * still check them.
+ */
+ColumnarReadState *
+columnar_begin_read(const char *filename, TupleDesc tupdesc,
+					Bitmapset *attrs_needed, List *quals, Index scanrelid)
+{
+	ColumnarReadState *state;
+	int			attnum;
+
+	state = (ColumnarReadState *) palloc0(sizeof(ColumnarReadState));
+	state->filename = pstrdup(filename);
+	state->tupdesc = tupdesc;
+	state->curstripe = -1;
+	state->columns = (ColumnReader *)
+		palloc0(tupdesc->natts * sizeof(ColumnReader));
+	state->stripecxt = AllocSetContextCreate(CurrentMemoryContext,
+											 "columnar_fdw stripe",
+											 ALLOCSET_DEFAULT_MINSIZE,
+											 ALLOCSET_DEFAULT_INITSIZE,
+											 ALLOCSET_DEFAULT_MAXSIZE);
+
+	state->attnums = (int *) palloc(tupdesc->natts * sizeof(int));
+	attnum = -1;
+	while ((attnum = bms_next_member(attrs_needed, attnum)) >= 0)
+	{
+		if (attnum < 1 || attnum > tupdesc->natts ||
+			tupdesc->attrs[attnum - 1]->attisdropped)
+			continue;
+		state->attnums[state->nattnums++] = attnum - 1;
+	}
+
+	state->bounds = make_stripe_bounds(quals, tupdesc, scanrelid);
+
+	/* A table that has never been written to has no file yet */
+	state->file = AllocateFile(filename, PG_BINARY_R);
+	if (state->file == NULL)
+	{
+		if (errno != ENOENT)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not open file \"%s\" for reading: %m",
+							filename)));
+	}
+	else
+		state->stripes = read_stripe_infos(state->file, filename,
+										   &state->nstripes);
+
+	return state;
+}
+
+/*
+ * Fetch the next row into values/isnull.  Returns false at the end.
+ */
+bool
+columnar_read_row(ColumnarReadState *state, Datum *values, bool *isnull)
+{
+	TupleDesc	tupdesc = state->tupdesc;
+	int			i;
+
+	while (state->curstripe < 0 ||
+		   state->currow >= state->stripes[state->curstripe].nrows)
+	{
+		StripeInfo *stripe;
+		MemoryContext oldcxt;
+		bool		refuted;
+
+		if (state->curstripe + 1 >= state->nstripes)
+			return false;
+		stripe = &state->stripes[++state->curstripe];
+		state->currow = 0;
+
+		/* the min/max values are copied into the stripe context */
+		MemoryContextReset(state->stripecxt);
+		memset(state->columns, 0, tupdesc->natts * sizeof(ColumnReader));
+		oldcxt = MemoryContextSwitchTo(state->stripecxt);
+		refuted = stripe_refuted(state, stripe);
+		MemoryContextSwitchTo(oldcxt);
+
+		if (refuted)
+		{
+			state->stripes_skipped++;
+			state->currow = stripe->nrows;
+			continue;
+		}
+		load_stripe(state, stripe);
+		state->stripes_read++;
+	}
+
+	memset(isnull, true, tupdesc->natts * sizeof(bool));
+	for (i = 0; i < state->nattnums; i++)
+	{
+		int			attno = state->attnums[i];
+		Form_pg_attribute att = tupdesc->attrs[attno];
+		ColumnReader *col = &state->columns[attno];
+		char	   *ptr;
+
+		if (col->data == NULL ||
+			(col->nullbitmap && att_isnull(state->currow, col->nullbitmap)))
+		{
+			values[attno] = (Datum) 0;
+			continue;
+		}
+
+		col->off = att_align_nominal(col->off, att->attalign);
+		ptr = col->values + col->off;
+		values[attno] = fetchatt(att, ptr);
+		isnull[attno] = false;
+		col->off = att_addlength_pointer(col->off, att->attlen, ptr);
+	}
+
+	state->currow++;
+	return true;
+}
+
+/*
+ * Start over from the first stripe.
+ */
+void
+columnar_rescan(ColumnarReadState *state)
+{
+	MemoryContextReset(state->stripecxt);
+	memset(state->columns, 0, state->tupdesc->natts * sizeof(ColumnReader));
+	state->curstripe = -1;
+	state->currow = 0;
+}
+
+void
+columnar_end_read(ColumnarReadState *state)
+{
+	if (state->file)
+		FreeFile(state->file);
+	MemoryContextDelete(state->stripecxt);
+}
+
+/*
+ * Report how many stripes were read and skipped so far, for EXPLAIN.
+ */
+void
+columnar_read_counts(ColumnarReadState *state,
+					 long *stripes_read, long *stripes_skipped)
+{
+	*stripes_read = state->stripes_read;
+	*stripes_skipped = state->stripes_skipped;
+}
+
+/*
+ * Count the rows in a columnar file, and the bytes a scan reading the given
+ * attributes would read.  A missing file is empty.
+ */
+void
+columnar_table_size(const char *filename, Bitmapset *attrs_needed,
+					double *nrows, double *nbytes)
+{
+	FILE	   *file;
+	StripeInfo *stripes;
+	int			nstripes;
+	int			i;
+
+	*nrows = 0;
+	*nbytes = 0;
+
+	file = AllocateFile(filename, PG_BINARY_R);
+	if (file == NULL)
+		return;
+	stripes = read_stripe_infos(file, filename, &nstripes);
+	FreeFile(file);
+
+	for (i = 0; i < nstripes; i++)
+	{
+		StripeInfo *stripe = &stripes[i];
+		uint32		col;
+
+		*nrows += stripe->nrows;
+		for (col = 0; col < stripe->ncolumns; col++)
+		{
+			if (bms_is_member(col + 1, attrs_needed))
+				*nbytes += stripe->entries[col].storedlen;
+		}
+	}
+}
+
+/*
+ * Read the headers of all the complete stripes in a file.
+ *
+ * A stripe that extends past the end of the file is being appended right
+ * now, or was cut short by a crash, so it and anything after it is ignored.
+ */
+static StripeInfo *
+read_stripe_infos(FILE *file, const char *filename, int *nstripes)
+{
+	struct stat st;
+	StripeInfo *stripes;
+	int			maxstripes = 16;
+	off_t		pos = 0;
+
+	if (fstat(fileno(file), &st) < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not stat file \"%s\": %m", filename)));
+
+	stripes = (StripeInfo *) palloc(maxstripes * sizeof(StripeInfo));
+	*nstripes = 0;
+
+	while (pos + (off_t) sizeof(StripeHeader) <= st.st_size)
+	{
+		StripeHeader header;
+		StripeInfo *stripe;
+		Size		restlen;
+		char	   *rest;
+
+		if (fseeko(file, pos, SEEK_SET) != 0 ||
+			fread(&header, sizeof(header), 1, file) != 1)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not read file \"%s\": %m", filename)));
+
+		if (header.magic != COLUMNAR_MAGIC ||
+			header.version != COLUMNAR_VERSION ||
+			header.headerlen < sizeof(StripeHeader) +
+			header.ncolumns * sizeof(ColumnEntry))
+			ereport(ERROR,
+					(errcode(ERRCODE_DATA_CORRUPTED),
+					 errmsg("invalid stripe header at offset %ld in file \"%s\"",
+							(long) pos, filename)));
+
+		if (pos + (off_t) header.headerlen + (off_t) header.datalen >
+			st.st_size)
+			break;
+
+		restlen = header.headerlen - sizeof(StripeHeader);
+		rest = palloc(restlen);
+		if (fread(rest, 1, restlen, file) != restlen)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not read file \"%s\": %m", filename)));
+
+		if (*nstripes >= maxstripes)
+		{
+			maxstripes *= 2;
+			stripes = (StripeInfo *)
+				repalloc(stripes, maxstripes * sizeof(StripeInfo));
+		}
+		stripe = &stripes[(*nstripes)++];
+		stripe->dataoffset = pos + header.headerlen;
+		stripe->nrows = header.nrows;
+		stripe->ncolumns = header.ncolumns;
+		stripe->entries = (ColumnEntry *) rest;
+		stripe->minmax = rest + header.ncolumns * sizeof(ColumnEntry);
+
+		pos += header.headerlen + header.datalen;
+	}
+
+	return stripes;
+}
+
+/*
+ * Pick out the quals that can refute a stripe, given its min and max.
+ */
+static List *
+make_stripe_bounds(List *quals, TupleDesc tupdesc, Index scanrelid)
+{
+	List	   *bounds = NIL;
+	ListCell   *lc;
+
+	foreach(lc, quals)
+	{
+		OpExpr	   *op = (OpExpr *) lfirst(lc);
+		Node	   *left;
+		Node	   *right;
+		Var		   *var;
+		Const	   *con;
+		Oid			opno;
+		Form_pg_attribute att;
+		TypeCacheEntry *typentry;
+		int			strategy;
+		Oid			lefttype;
+		Oid			righttype;
+		StripeBound *bound;
+
+		if (!IsA(op, OpExpr) || list_length(op->args) != 2)
+			continue;
+		left = (Node *) linitial(op->args);
+		right = (Node *) lsecond(op->args);
+		if (IsA(left, RelabelType))
+			left = (Node *) ((RelabelType *) left)->arg;
+		if (IsA(right, RelabelType))
+			right = (Node *) ((RelabelType *) right)->arg;
+
+		if (IsA(left, Var) && IsA(right, Const))
+		{
+			var = (Var *) left;
+			con = (Const *) right;
+			opno = op->opno;
+		}
+		else if (IsA(right, Var) && IsA(left, Const))
+		{
+			var = (Var *) right;
+			con = (Const *) left;
+			opno = get_commutator(op->opno);
+			if (!OidIsValid(opno))
+				continue;
+		}
+		else
+			continue;
+
+		if (var->varno != scanrelid || var->varlevelsup != 0 ||
+			var->varattno <= 0 || var->varattno > tupdesc->natts ||
+			con->constisnull)
+			continue;
+
+		/* The operator must belong to the opfamily the min/max came from */
+		att = tupdesc->attrs[var->varattno - 1];
+		typentry = lookup_type_cache(att->atttypid,
+									 TYPECACHE_BTREE_OPFAMILY |
+									 TYPECACHE_CMP_PROC_FINFO);
+		if (!OidIsValid(typentry->btree_opf) ||
+			!OidIsValid(typentry->cmp_proc_finfo.fn_oid) ||
+			!op_in_opfamily(opno, typentry->btree_opf))
+			continue;
+		get_op_opfamily_properties(opno, typentry->btree_opf, false,
+								   &strategy, &lefttype, &righttype);
+		if (lefttype != typentry->btree_opintype ||
+			righttype != typentry->btree_opintype ||
+			op->inputcollid != att->attcollation)
+			continue;
+
+		bound = (StripeBound *) palloc(sizeof(StripeBound));
+		bound->attnum = var->varattno;
+		bound->strategy = strategy;
+		bound->value = con->constvalue;
+		bound->cmpfn = &typentry->cmp_proc_finfo;
+		bound->collation = att->attcollation;
+		bounds = lappend(bounds, bound);
+	}
+
+	return bounds;
+}
+
+/*
+ * Can we tell from the stripe's min/max values that no row in it satisfies
+ * the quals?
+ */
+static bool
+stripe_refuted(ColumnarReadState *state, StripeInfo *stripe)
+{
+	ListCell   *lc;
+
+	foreach(lc, state->bounds)
+	{
+		StripeBound *bound = (StripeBound *) lfirst(lc);
+		Form_pg_attribute att = state->tupdesc->attrs[bound->attnum - 1];
+		ColumnEntry *entry;
+		char	   *ptr;
+		Datum		min;
+		Datum		max;
+		int			mincmp;
+		int			maxcmp;
+		uint32		i;
+
+		/* A column added after the stripe was written is all nulls */
+		if (bound->attnum > stripe->ncolumns)
+			return true;
+		entry = &stripe->entries[bound->attnum - 1];
+		if (entry->typid != att->atttypid)
+			continue;
+
+		/*
+		 * Min/max values are kept for every non-null value of a type with a
+		 * comparison function, so their absence means the column is all
+		 * nulls in this stripe.  btree operators are strict.
+		 */
+		if (!(entry->flags & COLUMN_HAS_MINMAX))
+			return true;
+
+		ptr = stripe->minmax;
+		for (i = 0; i < (uint32) bound->attnum - 1; i++)
+			ptr += stripe->entries[i].minlen + stripe->entries[i].maxlen;
+		min = deserialize_datum(ptr, att);
+		max = deserialize_datum(ptr + entry->minlen, att);
+
+		mincmp = DatumGetInt32(FunctionCall2Coll(bound->cmpfn,
+												 bound->collation,
+												 min, bound->value));
+		maxcmp = DatumGetInt32(FunctionCall2Coll(bound->cmpfn,
+												 bound->collation,
+												 max, bound->value));
+
+		switch (bound->strategy)
+		{
+			case BTLessStrategyNumber:
+				if (mincmp >= 0)
+					return true;
+				break;
+			case BTLessEqualStrategyNumber:
+				if (mincmp > 0)
+					return true;
+				break;
+			case BTEqualStrategyNumber:
+				if (mincmp > 0 || maxcmp < 0)
+					return true;
+				break;
+			case BTGreaterEqualStrategyNumber:
+				if (maxcmp < 0)
+					return true;
+				break;
+			case BTGreaterStrategyNumber:
+				if (maxcmp <= 0)
+					return true;
+				break;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Read and decompress the needed columns of a stripe.
+ */
+static void
+load_stripe(ColumnarReadState *state, StripeInfo *stripe)
+{
+	MemoryContext oldcxt;
+	int			i;
+
+	MemoryContextReset(state->stripecxt);
+	memset(state->columns, 0, state->tupdesc->natts * sizeof(ColumnReader));
+	oldcxt = MemoryContextSwitchTo(state->stripecxt);
+
+	for (i = 0; i < state->nattnums; i++)
+	{
+		int			attno = state->attnums[i];
+		Form_pg_attribute att = state->tupdesc->attrs[attno];
+		ColumnReader *col = &state->columns[attno];
+		ColumnEntry *entry;
+		char	   *stored;
+
+		/* columns added since the stripe was written read as nulls */
+		if (attno >= stripe->ncolumns)
+			continue;
+		entry = &stripe->entries[attno];
+		if (!OidIsValid(entry->typid))
+			continue;
+		if (entry->typid != att->atttypid)
+			ereport(ERROR,
+					(errcode(ERRCODE_DATATYPE_MISMATCH),
+					 errmsg("column \"%s\" of file \"%s\" was written with a different type",
+							NameStr(att->attname), state->filename)));
+
+		stored = palloc(entry->storedlen);
+		read_file_range(state, stripe->dataoffset + entry->offset,
+						stored, entry->storedlen);
+		if (entry->flags & COLUMN_COMPRESSED)
+		{
+			col->data = palloc(entry->rawlen);
+			if (pglz_decompress(stored, entry->storedlen, col->data,
+								entry->rawlen, true) != entry->rawlen)
+				ereport(ERROR,
+						(errcode(ERRCODE_DATA_CORRUPTED),
+						 errmsg("compressed data is corrupted in file \"%s\"",
+								state->filename)));
+			pfree(stored);
+		}
+		else
+			col->data = stored;
+
+		if (entry->flags & COLUMN_HAS_NULLS)
+		{
+			col->nullbitmap = (bits8 *) col->data;
+			col->values = col->data + MAXALIGN(BITMAPLEN(stripe->nrows));
+		}
+		else
+			col->values = col->data;
+		col->off = 0;
+	}
+
+	MemoryContextSwitchTo(oldcxt);
+}
+
+static void
+read_file_range(ColumnarReadState *state, off_t offset, char *buf, Size len)
+{
+	if (fseeko(state->file, offset, SEEK_SET) != 0 ||
+		fread(buf, 1, len, state->file) != len)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read file \"%s\": %m", state->filename)));
+}
+
+/*
+ * Turn a stored min/max value back into a datum.  The stored bytes aren't
+ * aligned, so they're copied first.
+ */
+static Datum
+deserialize_datum(char *ptr, Form_pg_attribute att)
+{
+	if (att->attbyval)
+	{
+		Datum		tmp = 0;
+
+		memcpy(&tmp, ptr, att->attlen);
+		return fetch_att(&tmp, true, att->attlen);
+	}
+	else
+	{
+		Size		len;
+		char	   *copy;
+
+		if (att->attlen > 0)
+			len = att->attlen;
+		else if (att->attlen == -1)
+		{
+			uint32		hdr;
+
+			/* always a 4-byte header, see columnar_write_row */
+			memcpy(&hdr, ptr, sizeof(hdr));
+			len = VARSIZE(&hdr);
+		}
+		else
+			len = strlen(ptr) + 1;
+
+		copy = palloc(len);
+		memcpy(copy, ptr, len);
+		return PointerGetDatum(copy);
+	}
+}
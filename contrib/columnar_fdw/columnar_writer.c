@@ -0,0 +1,419 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_writer.c
+ *		  Appending stripes to a columnar_fdw data file.
+ *
+ * Rows are buffered in memory column by column until a stripe is full.
+ * The stripe is then assembled into a single buffer and appended to the
+ * file with one write() call on a descriptor opened with O_APPEND, so that
+ * concurrent writers can't interleave their stripes, and a reader sees
+ * either a whole stripe or an incomplete one at the end of the file, which
+ * it ignores.
+ *
+ * Copyright (c) 2015, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		  contrib/columnar_fdw/columnar_writer.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "access/htup_details.h"
+#include "access/tupmacs.h"
+#include "common/pg_lzcompress.h"
+#include "storage/fd.h"
+#include "utils/datum.h"
+#include "utils/memutils.h"
+#include "utils/typcache.h"
+
+#include "columnar_fdw.h"
+
+/* Values of one column of the stripe being built */
+typedef struct ColumnBuffer
+{
+	StringInfoData values;		/* non-null values, aligned as in a tuple */
+	bool		hasnulls;		/* any nulls in this stripe yet? */
+	bits8	   *nullbitmap;		/* if so, bit set for each non-null value */
+	FmgrInfo   *cmpfn;			/* btree comparison function, if any */
+	bool		minmaxset;		/* min and max are valid */
+	Datum		min;
+	Datum		max;
+} ColumnBuffer;
+
+struct ColumnarWriteState
+{
+	char	   *filename;
+	TupleDesc	tupdesc;
+	int			stripe_rows;
+	bool		compress;
+	MemoryContext stripecxt;	/* holds the current stripe's data */
+	uint32		nrows;			/* rows in the current stripe */
+	Size		nbytes;			/* bytes of values in the current stripe */
+	ColumnBuffer *columns;		/* one per attribute */
+};
+
+static void columnar_start_stripe(ColumnarWriteState *state);
+static void columnar_flush_stripe(ColumnarWriteState *state);
+static void columnar_update_minmax(ColumnBuffer *col, Datum value,
+					   Form_pg_attribute att);
+
+
+/*
+ * Prepare to append rows to a columnar file, creating it if need be.
+ */
+ColumnarWriteState *
+columnar_begin_write(const char *filename, TupleDesc tupdesc,
+					 const ColumnarOptions *options)
+{
+	ColumnarWriteState *state;
+	int			fd;
+	int			i;
+
+	state = (ColumnarWriteState *) palloc0(sizeof(ColumnarWriteState));
+	state->filename = pstrdup(filename);
+	state->tupdesc = CreateTupleDescCopy(tupdesc);
+	state->stripe_rows = options->stripe_rows;
+	state->compress = options->compress;
+	state->stripecxt = AllocSetContextCreate(CurrentMemoryContext,
+											 "columnar_fdw stripe",
+											 ALLOCSET_DEFAULT_MINSIZE,
+											 ALLOCSET_DEFAULT_INITSIZE,
+											 ALLOCSET_DEFAULT_MAXSIZE);
+	state->columns = (ColumnBuffer *)
+		palloc0(tupdesc->natts * sizeof(ColumnBuffer));
+
+	/* Min/max values are kept for any type with a btree opclass */
+	for (i = 0; i < tupdesc->natts; i++)
+	{
+		Form_pg_attribute att = tupdesc->attrs[i];
+		TypeCacheEntry *typentry;
+
+		if (att->attisdropped)
+			continue;
+		typentry = lookup_type_cache(att->atttypid, TYPECACHE_CMP_PROC_FINFO);
+		if (OidIsValid(typentry->cmp_proc_finfo.fn_oid))
+			state->columns[i].cmpfn = &typentry->cmp_proc_finfo;
+	}
+
+	/* Make sure the file can be created before any data is buffered */
+	fd = OpenTransientFile((char *) filename,
+						   O_WRONLY | O_APPEND | O_CREAT | PG_BINARY,
+						   S_IRUSR | S_IWUSR);
+	if (fd < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not open file \"%s\" for writing: %m",
+						filename)));
+	CloseTransientFile(fd);
+
+	columnar_start_stripe(state);
+
+	return state;
+}
+
+/*
+ * Add one row to the table.
+ */
+void
+columnar_write_row(ColumnarWriteState *state, Datum *values, bool *isnull)
+{
+	TupleDesc	tupdesc = state->tupdesc;
+	MemoryContext oldcxt;
+	int			i;
+
+	oldcxt = MemoryContextSwitchTo(state->stripecxt);
+
+	for (i = 0; i < tupdesc->natts; i++)
+	{
+		Form_pg_attribute att = tupdesc->attrs[i];
+		ColumnBuffer *col = &state->columns[i];
+		StringInfo	buf = &col->values;
+		Datum		value = values[i];
+		Datum		orig = value;
+		Size		len;
+		int			off;
+
+		if (att->attisdropped)
+			continue;
+		if (isnull[i])
+		{
+			/* the bitmap is only needed once there is a null */
+			if (!col->hasnulls)
+			{
+				uint32		row;
+
+				col->nullbitmap = (bits8 *)
+					palloc0(BITMAPLEN(state->stripe_rows));
+				for (row = 0; row < state->nrows; row++)
+					col->nullbitmap[row / 8] |= 1 << (row % 8);
+				col->hasnulls = true;
+			}
+			continue;
+		}
+		if (col->hasnulls)
+			col->nullbitmap[state->nrows / 8] |= 1 << (state->nrows % 8);
+
+		/* store varlenas plain, since the whole column gets compressed */
+		if (att->attlen == -1)
+			value = PointerGetDatum(PG_DETOAST_DATUM(value));
+
+		off = att_align_nominal(buf->len, att->attalign);
+		len = att_addlength_datum(0, att->attlen, value);
+		enlargeStringInfo(buf, off - buf->len + len);
+		memset(buf->data + buf->len, 0, off - buf->len);
+		if (att->attbyval)
+			store_att_byval(buf->data + off, value, att->attlen);
+		else
+			memcpy(buf->data + off, DatumGetPointer(value), len);
+		buf->len = off + len;
+		state->nbytes += len;
+
+		if (col->cmpfn)
+			columnar_update_minmax(col, value, att);
+
+		if (value != orig)
+			pfree(DatumGetPointer(value));
+	}
+
+	MemoryContextSwitchTo(oldcxt);
+
+	state->nrows++;
+	if (state->nrows >= state->stripe_rows || state->nbytes >= MAX_STRIPE_BYTES)
+	{
+		columnar_flush_stripe(state);
+		columnar_start_stripe(state);
+	}
+}
+
+/*
+ * Write out any buffered rows and release the writer.
+ */
+void
+columnar_end_write(ColumnarWriteState *state)
+{
+	if (state->nrows > 0)
+		columnar_flush_stripe(state);
+	MemoryContextDelete(state->stripecxt);
+	pfree(state->columns);
+	pfree(state);
+}
+
+/*
+ * Append a datum to buf in its stored form, which is the same as in a heap
+ * tuple, except that varlenas must not be toasted.
+ */
+void
+columnar_serialize_datum(StringInfo buf, Datum value, Form_pg_attribute att)
+{
+	if (att->attbyval)
+	{
+		Datum		tmp;
+
+		store_att_byval(&tmp, value, att->attlen);
+		appendBinaryStringInfo(buf, (char *) &tmp, att->attlen);
+	}
+	else
+		appendBinaryStringInfo(buf, DatumGetPointer(value),
+							   att_addlength_datum(0, att->attlen, value));
+}
+
+/*
+ * Reset the column buffers for a new stripe.
+ */
+static void
+columnar_start_stripe(ColumnarWriteState *state)
+{
+	MemoryContext oldcxt;
+	int			i;
+
+	MemoryContextReset(state->stripecxt);
+	oldcxt = MemoryContextSwitchTo(state->stripecxt);
+
+	for (i = 0; i < state->tupdesc->natts; i++)
+	{
+		ColumnBuffer *col = &state->columns[i];
+
+		initStringInfo(&col->values);
+		col->hasnulls = false;
+		col->nullbitmap = NULL;
+		col->minmaxset = false;
+	}
+	state->nrows = 0;
+	state->nbytes = 0;
+
+	MemoryContextSwitchTo(oldcxt);
+}
+
+/*
+ * Assemble the current stripe and append it to the file.
+ */
+static void
+columnar_flush_stripe(ColumnarWriteState *state)
+{
+	TupleDesc	tupdesc = state->tupdesc;
+	int			natts = tupdesc->natts;
+	MemoryContext oldcxt;
+	StringInfoData stripe;
+	StringInfoData data;
+	StringInfoData minmax;
+	StripeHeader *header;
+	ColumnEntry *entries;
+	int			fd;
+	int			i;
+
+	oldcxt = MemoryContextSwitchTo(state->stripecxt);
+
+	initStringInfo(&data);
+	initStringInfo(&minmax);
+	entries = (ColumnEntry *) palloc0(natts * sizeof(ColumnEntry));
+
+	for (i = 0; i < natts; i++)
+	{
+		Form_pg_attribute att = tupdesc->attrs[i];
+		ColumnBuffer *col = &state->columns[i];
+		ColumnEntry *entry = &entries[i];
+		StringInfoData raw;
+		char	   *stored;
+		int32		storedlen;
+
+		if (att->attisdropped)
+			continue;
+		entry->typid = att->atttypid;
+
+		/* Build the uncompressed column data */
+		initStringInfo(&raw);
+		if (col->hasnulls)
+		{
+			entry->flags |= COLUMN_HAS_NULLS;
+			appendBinaryStringInfo(&raw, (char *) col->nullbitmap,
+								   BITMAPLEN(state->nrows));
+			while (raw.len != MAXALIGN(raw.len))
+				appendStringInfoChar(&raw, '\0');
+		}
+		appendBinaryStringInfo(&raw, col->values.data, col->values.len);
+		pfree(col->values.data);
+		col->values.data = NULL;
+
+		/* Compress it, unless that doesn't save enough to bother */
+		stored = raw.data;
+		storedlen = raw.len;
+		if (state->compress)
+		{
+			char	   *compressed = palloc(PGLZ_MAX_OUTPUT(raw.len));
+			int32		len;
+
+			len = pglz_compress(raw.data, raw.len, compressed,
+								PGLZ_strategy_default);
+			if (len >= 0)
+			{
+				entry->flags |= COLUMN_COMPRESSED;
+				stored = compressed;
+				storedlen = len;
+			}
+		}
+
+		entry->offset = data.len;
+		entry->rawlen = raw.len;
+		entry->storedlen = storedlen;
+		appendBinaryStringInfo(&data, stored, storedlen);
+		if (stored != raw.data)
+			pfree(stored);
+		pfree(raw.data);
+
+		if (col->minmaxset)
+		{
+			int			start = minmax.len;
+
+			entry->flags |= COLUMN_HAS_MINMAX;
+			columnar_serialize_datum(&minmax, col->min, att);
+			entry->minlen = minmax.len - start;
+			columnar_serialize_datum(&minmax, col->max, att);
+			entry->maxlen = minmax.len - start - entry->minlen;
+		}
+	}
+
+	/* Now put the pieces together */
+	initStringInfo(&stripe);
+	enlargeStringInfo(&stripe, sizeof(StripeHeader) +
+					  natts * sizeof(ColumnEntry) + minmax.len);
+	header = (StripeHeader *) stripe.data;
+	header->magic = COLUMNAR_MAGIC;
+	header->version = COLUMNAR_VERSION;
+	header->nrows = state->nrows;
+	header->ncolumns = natts;
+	header->headerlen = sizeof(StripeHeader) +
+		natts * sizeof(ColumnEntry) + minmax.len;
+	header->datalen = data.len;
+	stripe.len = sizeof(StripeHeader);
+	appendBinaryStringInfo(&stripe, (char *) entries,
+						   natts * sizeof(ColumnEntry));
+	appendBinaryStringInfo(&stripe, minmax.data, minmax.len);
+	appendBinaryStringInfo(&stripe, data.data, data.len);
+	pfree(data.data);
+
+	fd = OpenTransientFile(state->filename,
+						   O_WRONLY | O_APPEND | O_CREAT | PG_BINARY,
+						   S_IRUSR | S_IWUSR);
+	if (fd < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not open file \"%s\" for writing: %m",
+						state->filename)));
+	errno = 0;
+	if (write(fd, stripe.data, stripe.len) != stripe.len)
+	{
+		/* if write didn't set errno, assume problem is no disk space */
+		if (errno == 0)
+			errno = ENOSPC;
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write to file \"%s\": %m",
+						state->filename)));
+	}
+	if (pg_fsync(fd) != 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not fsync file \"%s\": %m",
+						state->filename)));
+	CloseTransientFile(fd);
+
+	MemoryContextSwitchTo(oldcxt);
+}
+
+/*
+ * Fold a new value into a column's min and max.  Replaced values are freed
+ * as we go, so that a sorted column doesn't keep a copy of every value.
+ */
+static void
+columnar_update_minmax(ColumnBuffer *col, Datum value, Form_pg_attribute att)
+{
+	Oid			collation = att->attcollation;
+
+	if (!col->minmaxset)
+	{
+		col->min = datumCopy(value, att->attbyval, att->attlen);
+		col->max = datumCopy(value, att->attbyval, att->attlen);
+		col->minmaxset = true;
+		return;
+	}
+
+	if (DatumGetInt32(FunctionCall2Coll(col->cmpfn, collation,
+										value, col->min)) < 0)
+	{
+		if (!att->attbyval)
+			pfree(DatumGetPointer(col->min));
+		col->min = datumCopy(value, att->attbyval, att->attlen);
+	}
+	else if (DatumGetInt32(FunctionCall2Coll(col->cmpfn, collation,
+											 value, col->max)) > 0)
+	{
+		if (!att->attbyval)
+			pfree(DatumGetPointer(col->max));
+		col->max = datumCopy(value, att->attbyval, att->attlen);
+	}
+}
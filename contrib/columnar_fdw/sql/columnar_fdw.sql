@@ -0,0 +1,56 @@
+--
+-- Test foreign-data wrapper columnar_fdw.
+--
+CREATE EXTENSION columnar_fdw;
+CREATE SERVER columnar_server FOREIGN DATA WRAPPER columnar_fdw;
+
+-- validator tests
+CREATE FOREIGN TABLE tbl () SERVER columnar_server OPTIONS (format 'csv');  -- ERROR
+CREATE FOREIGN TABLE tbl () SERVER columnar_server OPTIONS (stripe_rows '0');  -- ERROR
+CREATE FOREIGN TABLE tbl () SERVER columnar_server OPTIONS (stripe_rows 'x');  -- ERROR
+CREATE FOREIGN TABLE tbl () SERVER columnar_server OPTIONS (compression 'lz4');  -- ERROR
+ALTER SERVER columnar_server OPTIONS (ADD stripe_rows '10');  -- ERROR
+
+CREATE FOREIGN TABLE ct (a int, b text, c float8) SERVER columnar_server
+  OPTIONS (stripe_rows '100');
+
+-- a table that has never been written to is empty
+SELECT count(*) FROM ct;
+
+INSERT INTO ct
+  SELECT i, 'row ' || i, CASE WHEN i % 10 = 0 THEN NULL ELSE i / 2.0 END
+  FROM generate_series(1, 1000) i;
+SELECT count(*), count(c), min(a), max(a), sum(length(b)) FROM ct;
+SELECT * FROM ct WHERE a BETWEEN 498 AND 502 ORDER BY a;
+SELECT * FROM ct WHERE a = 1000;
+SELECT a FROM ct WHERE b = 'row 17';
+SELECT count(*) FROM ct WHERE a > 2000;
+
+COPY ct FROM stdin;
+1001	copied	0.25
+1002	\N	\N
+\.
+SELECT * FROM ct WHERE a > 1000 ORDER BY a;
+
+-- rows are only appended
+UPDATE ct SET b = 'x';  -- ERROR
+DELETE FROM ct;  -- ERROR
+
+-- rows written before a column was added read it as null
+ALTER FOREIGN TABLE ct ADD COLUMN d int;
+INSERT INTO ct VALUES (1003, 'new', 3, 33);
+SELECT * FROM ct WHERE a > 1000 ORDER BY a;
+SELECT a, d FROM ct WHERE d = 33;
+ALTER FOREIGN TABLE ct DROP COLUMN c;
+SELECT * FROM ct WHERE a >= 1002 ORDER BY a;
+
+-- uncompressed tables
+CREATE FOREIGN TABLE ct2 (x int8, y varchar(10)) SERVER columnar_server
+  OPTIONS (compression 'none');
+INSERT INTO ct2 SELECT i, repeat('y', i % 11) FROM generate_series(1, 50) i;
+SELECT sum(x), sum(length(y)), min(y), max(y) FROM ct2;
+
+-- cleanup
+DROP FOREIGN TABLE ct2;
+DROP SERVER columnar_server CASCADE;
+DROP EXTENSION columnar_fdw;
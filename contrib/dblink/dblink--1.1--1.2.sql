@@ -0,0 +1,19 @@
+/* contrib/dblink/dblink--1.1--1.2.sql */
+
+-- complain if script is sourced in psql, rather than via ALTER EXTENSION
+\echo Use "ALTER EXTENSION dblink UPDATE TO '1.2'" to load this file. \quit
+
+CREATE FUNCTION dblink_send_query(text, text, bool)
+RETURNS int4
+AS 'MODULE_PATHNAME', 'dblink_send_query'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION dblink_wait_any(text[])
+RETURNS text
+AS 'MODULE_PATHNAME', 'dblink_wait_any'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION dblink_wait_any(text[], int4)
+RETURNS text
+AS 'MODULE_PATHNAME', 'dblink_wait_any'
+LANGUAGE C STRICT;
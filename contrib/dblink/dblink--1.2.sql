@@ -1,4 +1,4 @@
-/* contrib/dblink/dblink--1.1.sql */
+/* contrib/dblink/dblink--1.2.sql */
 
 -- complain if script is sourced in psql, rather than via CREATE EXTENSION
 \echo Use "CREATE EXTENSION dblink" to load this file. \quit
@@ -173,6 +173,11 @@ RETURNS int4
 AS 'MODULE_PATHNAME', 'dblink_send_query'
 LANGUAGE C STRICT;
 
+CREATE FUNCTION dblink_send_query(text, text, bool)
+RETURNS int4
+AS 'MODULE_PATHNAME', 'dblink_send_query'
+LANGUAGE C STRICT;
+
 CREATE FUNCTION dblink_is_busy(text)
 RETURNS int4
 AS 'MODULE_PATHNAME', 'dblink_is_busy'
@@ -188,6 +193,16 @@ RETURNS SETOF record
 AS 'MODULE_PATHNAME', 'dblink_get_result'
 LANGUAGE C STRICT;
 
+CREATE FUNCTION dblink_wait_any(text[])
+RETURNS text
+AS 'MODULE_PATHNAME', 'dblink_wait_any'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION dblink_wait_any(text[], int4)
+RETURNS text
+AS 'MODULE_PATHNAME', 'dblink_wait_any'
+LANGUAGE C STRICT;
+
 CREATE FUNCTION dblink_get_connections()
 RETURNS text[]
 AS 'MODULE_PATHNAME', 'dblink_get_connections'
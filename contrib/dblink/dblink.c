@@ -33,6 +33,15 @@
 #include "postgres.h"
 
 #include <limits.h>
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+#ifdef HAVE_SYS_POLL_H
+#include <sys/poll.h>
+#endif
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
 
 #include "libpq-fe.h"
 
@@ -57,6 +66,7 @@
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
+#include "utils/timestamp.h"
 #include "utils/tqual.h"
 
 #include "dblink.h"
@@ -95,6 +105,10 @@ static void materializeQueryResult(FunctionCallInfo fcinfo,
 					   const char *sql,
 					   bool fail);
 static PGresult *storeQueryResult(volatile storeInfo *sinfo, PGconn *conn, const char *sql);
+static void materializeStreamedResult(FunctionCallInfo fcinfo, PGconn *conn,
+						  const char *conname, PGresult *res, bool fail);
+static void storeStreamedResult(volatile storeInfo *sinfo, PGconn *conn);
+static void dblink_wait_sockets(PGconn **conns, int nconns, long timeout);
 static void storeRow(volatile storeInfo *sinfo, PGresult *res, bool first);
 static remoteConn *getConnectionByName(const char *name);
 static HTAB *createConnHash(void);
@@ -633,9 +647,17 @@ dblink_send_query(PG_FUNCTION_ARGS)
 	PGconn	   *conn = NULL;
 	char	   *sql = NULL;
 	remoteConn *rconn = NULL;
+	bool		single_row = false;
 	int			retval;
 
-	if (PG_NARGS() == 2)
+	if (PG_NARGS() == 3)
+	{
+		/* text,text,bool */
+		DBLINK_GET_NAMED_CONN;
+		sql = text_to_cstring(PG_GETARG_TEXT_PP(1));
+		single_row = PG_GETARG_BOOL(2);
+	}
+	else if (PG_NARGS() == 2)
 	{
 		DBLINK_GET_NAMED_CONN;
 		sql = text_to_cstring(PG_GETARG_TEXT_PP(1));
@@ -649,6 +671,13 @@ dblink_send_query(PG_FUNCTION_ARGS)
 	if (retval != 1)
 		elog(NOTICE, "could not send query: %s", PQerrorMessage(conn));
 
+	/*
+	 * In single-row mode, dblink_get_result converts the rows as they
+	 * arrive, rather than after libpq has collected the whole result.
+	 */
+	else if (single_row && !PQsetSingleRowMode(conn))	/* shouldn't fail */
+		elog(ERROR, "failed to set single-row mode for dblink query");
+
 	PG_RETURN_INT32(retval);
 }
 
@@ -747,8 +776,14 @@ dblink_record_internal(FunctionCallInfo fcinfo, bool is_async)
 			/* NULL means we're all done with the async results */
 			if (res)
 			{
-				if (PQresultStatus(res) != PGRES_COMMAND_OK &&
-					PQresultStatus(res) != PGRES_TUPLES_OK)
+				if (PQresultStatus(res) == PGRES_SINGLE_TUPLE)
+				{
+					/* query sent in single-row mode, collect the rows */
+					materializeStreamedResult(fcinfo, conn, conname, res,
+											  fail);
+				}
+				else if (PQresultStatus(res) != PGRES_COMMAND_OK &&
+						 PQresultStatus(res) != PGRES_TUPLES_OK)
 				{
 					dblink_res_error(conname, res, "could not execute query",
 									 fail);
@@ -1138,6 +1173,98 @@ storeQueryResult(volatile storeInfo *sinfo, PGconn *conn, const char *sql)
 	return res;
 }
 
+/*
+ * Store the rows of a result set that arrives in single-row mode into a
+ * tuplestore to be returned as the result of the current function.  'res'
+ * is its first row, which is released here.
+ *
+ * Unlike materializeQueryResult, we read only the one result set, leaving
+ * any later ones for the next dblink_get_result call.
+ */
+static void
+materializeStreamedResult(FunctionCallInfo fcinfo, PGconn *conn,
+						  const char *conname, PGresult *res, bool fail)
+{
+	volatile storeInfo sinfo;
+
+	/* prepTuplestoreResult must have been called previously */
+	Assert(((ReturnSetInfo *) fcinfo->resultinfo)->returnMode ==
+		   SFRM_Materialize);
+
+	/* initialize storeInfo to empty */
+	memset((void *) &sinfo, 0, sizeof(sinfo));
+	sinfo.fcinfo = fcinfo;
+	sinfo.cur_res = res;
+
+	PG_TRY();
+	{
+		/* Create short-lived memory context for data conversions */
+		sinfo.tmpcontext = AllocSetContextCreate(CurrentMemoryContext,
+												 "dblink temporary context",
+												 ALLOCSET_DEFAULT_MINSIZE,
+												 ALLOCSET_DEFAULT_INITSIZE,
+												 ALLOCSET_DEFAULT_MAXSIZE);
+
+		/* collect the rows; this leaves the result set's final PGresult */
+		storeStreamedResult(&sinfo, conn);
+		res = sinfo.cur_res;
+		sinfo.cur_res = NULL;
+
+		if (PQresultStatus(res) != PGRES_TUPLES_OK)
+		{
+			dblink_res_error(conname, res, "could not execute query", fail);
+			/* if fail isn't set, we'll return the rows we got */
+		}
+		else
+			PQclear(res);
+
+		/* clean up data conversion short-lived memory context */
+		MemoryContextDelete(sinfo.tmpcontext);
+		sinfo.tmpcontext = NULL;
+	}
+	PG_CATCH();
+	{
+		/* be sure to release any libpq result we collected */
+		PQclear(sinfo.cur_res);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+}
+
+/*
+ * Send the rows of a single-row-mode result set to sinfo->tuplestore, one at
+ * a time as they arrive, starting with the one in sinfo->cur_res.  The
+ * PGresult that ends the result set is left in sinfo->cur_res.
+ */
+static void
+storeStreamedResult(volatile storeInfo *sinfo, PGconn *conn)
+{
+	bool		first = true;
+	int			nestlevel = -1;
+
+	while (PQresultStatus(sinfo->cur_res) == PGRES_SINGLE_TUPLE)
+	{
+		/* Set GUCs to ensure we read GUC-sensitive data types correctly */
+		if (first)
+			nestlevel = applyRemoteGucs(conn);
+
+		storeRow(sinfo, sinfo->cur_res, first);
+
+		PQclear(sinfo->cur_res);
+		sinfo->cur_res = NULL;
+		first = false;
+
+		CHECK_FOR_INTERRUPTS();
+
+		sinfo->cur_res = PQgetResult(conn);
+		if (!sinfo->cur_res)	/* shouldn't happen */
+			elog(ERROR, "unexpected end of dblink query result");
+	}
+
+	/* clean up GUC settings, if we changed any */
+	restoreLocalGucs(nestlevel);
+}
+
 /*
  * Send single row to sinfo->tuplestore.
  *
@@ -1305,6 +1432,81 @@ dblink_is_busy(PG_FUNCTION_ARGS)
 	PG_RETURN_INT32(PQisBusy(conn));
 }
 
+/*
+ * Waits until one of a set of connections has a query result ready
+ *
+ * Returns text:
+ *	the name of a connection whose result can be fetched with
+ *	dblink_get_result without blocking, or NULL if the timeout expired
+ *	first.  A connection with no query in progress counts as ready.
+ *
+ * Params:
+ *	text[] connection_names - names of the connections to wait for
+ *	int timeout - milliseconds to wait at most; -1, the default, waits
+ *	indefinitely
+ */
+PG_FUNCTION_INFO_V1(dblink_wait_any);
+Datum
+dblink_wait_any(PG_FUNCTION_ARGS)
+{
+	char	  **connames;
+	PGconn	  **conns;
+	int			nconns;
+	int			timeout = -1;
+	TimestampTz deadline = 0;
+	int			i;
+
+	DBLINK_INIT;
+
+	connames = get_text_array_contents(PG_GETARG_ARRAYTYPE_P(0), &nconns);
+	if (PG_NARGS() == 2)
+		timeout = PG_GETARG_INT32(1);
+
+	conns = (PGconn **) palloc(nconns * sizeof(PGconn *));
+	for (i = 0; i < nconns; i++)
+	{
+		char	   *conname = connames[i];
+		remoteConn *rconn = NULL;
+
+		if (conname != NULL)
+			rconn = getConnectionByName(conname);
+		if (!rconn)
+			DBLINK_CONN_NOT_AVAIL;
+		conns[i] = rconn->conn;
+	}
+
+	if (timeout >= 0)
+		deadline = TimestampTzPlusMilliseconds(GetCurrentTimestamp(), timeout);
+
+	for (;;)
+	{
+		long		secs = -1;
+		int			usecs = 0;
+
+		/*
+		 * A connection is ready once libpq has read a whole result, or if it
+		 * has failed; dblink_get_result will report the failure.
+		 */
+		for (i = 0; i < nconns; i++)
+		{
+			if (!PQconsumeInput(conns[i]) || !PQisBusy(conns[i]))
+				PG_RETURN_TEXT_P(cstring_to_text(connames[i]));
+		}
+
+		if (timeout >= 0)
+		{
+			TimestampTz now = GetCurrentTimestamp();
+
+			if (now >= deadline)
+				PG_RETURN_NULL();
+			TimestampDifference(now, deadline, &secs, &usecs);
+		}
+
+		dblink_wait_sockets(conns, nconns,
+							secs < 0 ? -1 : secs * 1000 + (usecs + 999) / 1000);
+	}
+}
+
 /*
  * Cancels a running request on a connection
  *
@@ -2718,6 +2920,78 @@ dblink_res_error(const char *conname, PGresult *res, const char *dblink_context_
 /*
  * Obtain connection string for a foreign server
  */
+/*
+ * Wait until the socket of one of the given connections becomes readable,
+ * or until timeout milliseconds have passed, if timeout isn't -1.
+ */
+static void
+dblink_wait_sockets(PGconn **conns, int nconns, long timeout)
+{
+	int			rc;
+	int			i;
+#ifdef HAVE_POLL
+	struct pollfd *pfds;
+#else
+	fd_set		input_mask;
+	pgsocket	maxsock = 0;
+	struct timeval tv;
+#endif
+
+#ifdef HAVE_POLL
+	pfds = (struct pollfd *) palloc(nconns * sizeof(struct pollfd));
+	for (i = 0; i < nconns; i++)
+	{
+		pfds[i].fd = PQsocket(conns[i]);
+		pfds[i].events = POLLIN;
+		pfds[i].revents = 0;
+	}
+#endif
+
+	/*
+	 * Wake up every second to check for interrupts, in case the signal
+	 * arrived just before we started waiting.
+	 */
+	for (;;)
+	{
+		long		wait = (timeout < 0 || timeout > 1000) ? 1000 : timeout;
+
+		CHECK_FOR_INTERRUPTS();
+
+#ifdef HAVE_POLL
+		rc = poll(pfds, nconns, (int) wait);
+#else
+		FD_ZERO(&input_mask);
+		for (i = 0; i < nconns; i++)
+		{
+			pgsocket	sock = PQsocket(conns[i]);
+
+			FD_SET(sock, &input_mask);
+			if (sock > maxsock)
+				maxsock = sock;
+		}
+		tv.tv_sec = wait / 1000;
+		tv.tv_usec = (wait % 1000) * 1000;
+		rc = select(maxsock + 1, &input_mask, NULL, NULL, &tv);
+#endif
+		if (rc < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			ereport(ERROR,
+					(errcode_for_socket_access(),
+					 errmsg("could not wait for dblink connections: %m")));
+		}
+		if (rc > 0 || wait == timeout)
+			break;
+		if (timeout > 0)
+			timeout -= wait;
+	}
+
+#ifdef HAVE_POLL
+	pfree(pfds);
+#endif
+}
+
 static char *
 get_connect_string(const char *servername)
 {
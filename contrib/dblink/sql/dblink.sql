@@ -382,6 +382,23 @@ SELECT dblink_disconnect('dtest3');
 
 SELECT * from result;
 
+-- test single-row mode, and waiting for any of several connections
+SELECT dblink_connect('dtest1', connection_parameters());
+SELECT dblink_connect('dtest2', connection_parameters());
+SELECT dblink_send_query('dtest1', 'select * from foo where f1 < 3', true);
+SELECT dblink_send_query('dtest2', 'select * from foo where f1 > 8', true);
+SELECT dblink_wait_any(ARRAY['dtest1', 'dtest2']) IN ('dtest1', 'dtest2') AS ready;
+SELECT * from dblink_get_result('dtest1') as t1(f1 int, f2 text, f3 text[]);
+SELECT * from dblink_get_result('dtest1') as t1(f1 int, f2 text, f3 text[]);
+SELECT * from dblink_get_result('dtest2') as t2(f1 int, f2 text, f3 text[]);
+SELECT * from dblink_get_result('dtest2') as t2(f1 int, f2 text, f3 text[]);
+-- connections with no query in progress are ready at once
+SELECT dblink_wait_any(ARRAY['dtest2', 'dtest1'], 0);
+-- should generate 'connection "dtest4" not available' error
+SELECT dblink_wait_any(ARRAY['dtest1', 'dtest4']);
+SELECT dblink_disconnect('dtest1');
+SELECT dblink_disconnect('dtest2');
+
 SELECT dblink_connect('dtest1', connection_parameters());
 SELECT * from
  dblink_send_query('dtest1', 'select * from foo where f1 < 3') as t1;
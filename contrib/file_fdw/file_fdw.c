@@ -12,7 +12,9 @@
  */
 #include "postgres.h"
 
+#include <math.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <unistd.h>
 
 #include "access/htup_details.h"
@@ -25,6 +27,7 @@
 #include "commands/vacuum.h"
 #include "foreign/fdwapi.h"
 #include "foreign/foreign.h"
+#include "mb/pg_wchar.h"
 #include "miscadmin.h"
 #include "nodes/makefuncs.h"
 #include "optimizer/cost.h"
@@ -32,6 +35,8 @@
 #include "optimizer/planmain.h"
 #include "optimizer/restrictinfo.h"
 #include "optimizer/var.h"
+#include "port/atomics.h"
+#include "storage/fd.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
 #include "utils/sampling.h"
@@ -80,6 +85,48 @@ static const struct FileFdwOption valid_options[] = {
 	{NULL, InvalidOid}
 };
 
+/*
+ * Size of the byte ranges that the participants of a parallel scan take
+ * turns to read.
+ */
+#define FILE_FDW_CHUNK_SIZE		(1024 * 1024)
+
+/*
+ * Shared state of a parallel scan, in the dynamic shared memory segment of
+ * the Gather node above it: the number of the next chunk to hand out.
+ */
+typedef struct FileFdwParallelScan
+{
+	pg_atomic_uint64 next_chunk;
+} FileFdwParallelScan;
+
+/*
+ * State for reading a text-format file a range of bytes at a time, rather
+ * than from start to end.  Each range is extended to whole lines: a line
+ * belongs to the range in which it starts.  Parallel scans read the chunks
+ * handed out through a FileFdwParallelScan, and ANALYZE of a large file
+ * reads a random sample of its blocks.
+ *
+ * The bytes are fed to the COPY code through file_read_data(), which finds
+ * the reader in active_reader; this must be set around every NextCopyFrom
+ * call.
+ */
+typedef struct FileRangeReader
+{
+	char	   *filename;		/* file to read */
+	int			fd;				/* open file descriptor */
+	off_t		filesize;		/* size of file when we opened it */
+	off_t		rangesize;		/* size of the ranges */
+	off_t		pos;			/* file offset of the next byte to return */
+	off_t		end;			/* end of current range */
+	bool		in_range;		/* still returning lines of current range? */
+	bool		finishing;		/* returning the rest of its last line? */
+	int			nbackslashes;	/* backslashes just before pos */
+	double		nranges;		/* number of ranges started so far */
+	FileFdwParallelScan *pscan; /* shared state, for a parallel scan */
+	BlockSamplerData bs;		/* blocks to sample, for ANALYZE */
+} FileRangeReader;
+
 /*
  * FDW-specific information for RelOptInfo.fdw_private.
  */
@@ -99,8 +146,12 @@ typedef struct FileFdwExecutionState
 	char	   *filename;		/* file to read */
 	List	   *options;		/* merged COPY options, excluding filename */
 	CopyState	cstate;			/* state of reading file */
+	FileRangeReader *reader;	/* reader for a parallel scan, or NULL */
 } FileFdwExecutionState;
 
+/* The reader file_read_data() reads from */
+static FileRangeReader *active_reader = NULL;
+
 /*
  * SQL functions
  */
@@ -130,6 +181,16 @@ static void fileEndForeignScan(ForeignScanState *node);
 static bool fileAnalyzeForeignTable(Relation relation,
 						AcquireSampleRowsFunc *func,
 						BlockNumber *totalpages);
+static bool fileIsForeignScanParallelSafe(PlannerInfo *root, RelOptInfo *rel,
+							  RangeTblEntry *rte);
+static Size fileEstimateDSMForeignScan(ForeignScanState *node,
+						   ParallelContext *pcxt);
+static void fileInitializeDSMForeignScan(ForeignScanState *node,
+							 ParallelContext *pcxt,
+							 void *coordinate);
+static void fileInitializeWorkerForeignScan(ForeignScanState *node,
+								shm_toc *toc,
+								void *coordinate);
 
 /*
  * Helper functions
@@ -144,11 +205,23 @@ static bool check_selective_binary_conversion(RelOptInfo *baserel,
 static void estimate_size(PlannerInfo *root, RelOptInfo *baserel,
 			  FileFdwPlanState *fdw_private);
 static void estimate_costs(PlannerInfo *root, RelOptInfo *baserel,
-			   FileFdwPlanState *fdw_private,
+			   FileFdwPlanState *fdw_private, double parallel_divisor,
 			   Cost *startup_cost, Cost *total_cost);
 static int file_acquire_sample_rows(Relation onerel, int elevel,
 						 HeapTuple *rows, int targrows,
 						 double *totalrows, double *totaldeadrows);
+static bool file_is_splittable(List *options);
+static void file_begin_parallel_scan(ForeignScanState *node,
+						 FileFdwParallelScan *pscan);
+static void file_end_parallel_scan(FileFdwExecutionState *festate);
+static FileRangeReader *file_open_range_reader(const char *filename,
+					   off_t rangesize);
+static void file_close_range_reader(FileRangeReader *reader);
+static bool file_next_range(FileRangeReader *reader);
+static int	file_pread(FileRangeReader *reader, char *buf, int len, off_t off);
+static off_t file_find_line_start(FileRangeReader *reader, off_t start);
+static int	file_find_line_end(FileRangeReader *reader, char *buf, int len);
+static int	file_read_data(void *outbuf, int minread, int maxread);
 
 
 /*
@@ -169,6 +242,10 @@ file_fdw_handler(PG_FUNCTION_ARGS)
 	fdwroutine->ReScanForeignScan = fileReScanForeignScan;
 	fdwroutine->EndForeignScan = fileEndForeignScan;
 	fdwroutine->AnalyzeForeignTable = fileAnalyzeForeignTable;
+	fdwroutine->IsForeignScanParallelSafe = fileIsForeignScanParallelSafe;
+	fdwroutine->EstimateDSMForeignScan = fileEstimateDSMForeignScan;
+	fdwroutine->InitializeDSMForeignScan = fileInitializeDSMForeignScan;
+	fdwroutine->InitializeWorkerForeignScan = fileInitializeWorkerForeignScan;
 
 	PG_RETURN_POINTER(fdwroutine);
 }
@@ -489,7 +566,8 @@ fileGetForeignRelSize(PlannerInfo *root,
  *
  *		Currently we don't support any push-down feature, so there is only one
  *		possible access path, which simply returns all records in the order in
- *		the data file.
+ *		the data file; plus, for a large enough text-format file, a partial
+ *		path that lets several parallel workers read it a chunk at a time.
  */
 static void
 fileGetForeignPaths(PlannerInfo *root,
@@ -510,7 +588,7 @@ fileGetForeignPaths(PlannerInfo *root,
 										  (Node *) columns));
 
 	/* Estimate costs */
-	estimate_costs(root, baserel, fdw_private,
+	estimate_costs(root, baserel, fdw_private, 1.0,
 				   &startup_cost, &total_cost);
 
 	/*
@@ -532,6 +610,52 @@ fileGetForeignPaths(PlannerInfo *root,
 	 * appropriate pathkeys into the ForeignPath node to tell the planner
 	 * that.
 	 */
+
+	/*
+	 * Consider a parallel scan, if the file can be split into chunks at line
+	 * boundaries.  The degree of parallelism is chosen the same way as for a
+	 * parallel sequential scan of a table of the same size.
+	 */
+	if (baserel->consider_parallel && baserel->lateral_relids == NULL &&
+		file_is_splittable(fdw_private->options))
+	{
+		BlockNumber parallel_threshold = 1000;
+		int			parallel_degree = 1;
+		ForeignPath *partial_path;
+
+		if (fdw_private->pages < parallel_threshold &&
+			baserel->reloptkind == RELOPT_BASEREL)
+			return;
+
+		while (fdw_private->pages > parallel_threshold * 3 &&
+			   parallel_degree < max_parallel_degree)
+		{
+			parallel_degree++;
+			parallel_threshold *= 3;
+			if (parallel_threshold >= PG_INT32_MAX / 3)
+				break;
+		}
+
+		partial_path = create_foreignscan_path(root, baserel,
+											   baserel->rows,
+											   0, 0,
+											   NIL,		/* no pathkeys */
+											   NULL,	/* no outer rel */
+											   coptions);
+		partial_path->path.parallel_aware = true;
+		partial_path->path.parallel_degree = parallel_degree;
+
+		/* Each participant returns its share of the rows */
+		estimate_costs(root, baserel, fdw_private,
+					   get_parallel_divisor(&partial_path->path),
+					   &partial_path->path.startup_cost,
+					   &partial_path->path.total_cost);
+		partial_path->path.rows =
+			clamp_row_est(baserel->rows /
+						  get_parallel_divisor(&partial_path->path));
+
+		add_partial_path(baserel, (Path *) partial_path);
+	}
 }
 
 /*
@@ -637,6 +761,7 @@ fileBeginForeignScan(ForeignScanState *node, int eflags)
 	festate->filename = filename;
 	festate->options = options;
 	festate->cstate = cstate;
+	festate->reader = NULL;
 
 	node->fdw_state = (void *) festate;
 }
@@ -673,9 +798,11 @@ fileIterateForeignScan(ForeignScanState *node)
 	 * foreign tables.
 	 */
 	ExecClearTuple(slot);
+	active_reader = festate->reader;
 	found = NextCopyFrom(festate->cstate, NULL,
 						 slot->tts_values, slot->tts_isnull,
 						 NULL);
+	active_reader = NULL;
 	if (found)
 		ExecStoreVirtualTuple(slot);
 
@@ -694,6 +821,15 @@ fileReScanForeignScan(ForeignScanState *node)
 {
 	FileFdwExecutionState *festate = (FileFdwExecutionState *) node->fdw_state;
 
+	/*
+	 * A parallel scan's shared state belongs to the Gather node above us,
+	 * which tears it down before rescanning us and calls
+	 * fileInitializeDSMForeignScan again to set up a fresh one.  Meanwhile,
+	 * go back to reading the whole file.
+	 */
+	if (festate->reader)
+		file_end_parallel_scan(festate);
+
 	EndCopyFrom(festate->cstate);
 
 	festate->cstate = BeginCopyFrom(node->ss.ss_currentRelation,
@@ -714,7 +850,11 @@ fileEndForeignScan(ForeignScanState *node)
 
 	/* if festate is NULL, we are in EXPLAIN; nothing to do */
 	if (festate)
+	{
 		EndCopyFrom(festate->cstate);
+		if (festate->reader)
+			file_close_range_reader(festate->reader);
+	}
 }
 
 /*
@@ -756,6 +896,98 @@ fileAnalyzeForeignTable(Relation relation,
 	return true;
 }
 
+/*
+ * fileIsForeignScanParallelSafe
+ *		Reading a file works the same in a parallel worker as in the leader
+ */
+static bool
+fileIsForeignScanParallelSafe(PlannerInfo *root, RelOptInfo *rel,
+							  RangeTblEntry *rte)
+{
+	return true;
+}
+
+/*
+ * fileEstimateDSMForeignScan
+ *		Size of the shared state of a parallel scan
+ */
+static Size
+fileEstimateDSMForeignScan(ForeignScanState *node, ParallelContext *pcxt)
+{
+	return sizeof(FileFdwParallelScan);
+}
+
+/*
+ * fileInitializeDSMForeignScan
+ *		Set up the shared state of a parallel scan, and join in the scan
+ */
+static void
+fileInitializeDSMForeignScan(ForeignScanState *node, ParallelContext *pcxt,
+							 void *coordinate)
+{
+	FileFdwParallelScan *pscan = (FileFdwParallelScan *) coordinate;
+
+	pg_atomic_init_u64(&pscan->next_chunk, 0);
+
+	/* The leader participates in the scan, too. */
+	file_begin_parallel_scan(node, pscan);
+}
+
+/*
+ * fileInitializeWorkerForeignScan
+ *		Join in a parallel scan in a worker
+ */
+static void
+fileInitializeWorkerForeignScan(ForeignScanState *node, shm_toc *toc,
+								void *coordinate)
+{
+	file_begin_parallel_scan(node, (FileFdwParallelScan *) coordinate);
+}
+
+/*
+ * file_begin_parallel_scan
+ *		Switch a scan over to reading the chunks handed out through pscan
+ */
+static void
+file_begin_parallel_scan(ForeignScanState *node, FileFdwParallelScan *pscan)
+{
+	FileFdwExecutionState *festate = (FileFdwExecutionState *) node->fdw_state;
+	MemoryContext oldcontext;
+
+	/* if festate is NULL, we are in EXPLAIN; nothing to do */
+	if (festate == NULL)
+		return;
+
+	oldcontext = MemoryContextSwitchTo(node->ss.ps.state->es_query_cxt);
+
+	if (festate->reader)
+		file_end_parallel_scan(festate);
+	EndCopyFrom(festate->cstate);
+
+	festate->reader = file_open_range_reader(festate->filename,
+											 FILE_FDW_CHUNK_SIZE);
+	festate->reader->pscan = pscan;
+	festate->cstate = BeginCopyFromReader(node->ss.ss_currentRelation,
+										  file_read_data,
+										  NIL,
+										  festate->options);
+
+	MemoryContextSwitchTo(oldcontext);
+}
+
+/*
+ * file_end_parallel_scan
+ *		Forget about the shared state of a parallel scan
+ *
+ * The caller is expected to replace festate->cstate, which reads from it.
+ */
+static void
+file_end_parallel_scan(FileFdwExecutionState *festate)
+{
+	file_close_range_reader(festate->reader);
+	festate->reader = NULL;
+}
+
 /*
  * check_selective_binary_conversion
  *
@@ -960,11 +1192,13 @@ estimate_size(PlannerInfo *root, RelOptInfo *baserel,
 /*
  * Estimate costs of scanning a foreign table.
  *
- * Results are returned in *startup_cost and *total_cost.
+ * Results are returned in *startup_cost and *total_cost.  For a parallel
+ * scan, parallel_divisor is the number of participants' worth of work done,
+ * and the CPU costs are divided by it; otherwise pass 1.0.
  */
 static void
 estimate_costs(PlannerInfo *root, RelOptInfo *baserel,
-			   FileFdwPlanState *fdw_private,
+			   FileFdwPlanState *fdw_private, double parallel_divisor,
 			   Cost *startup_cost, Cost *total_cost)
 {
 	BlockNumber pages = fdw_private->pages;
@@ -980,9 +1214,13 @@ estimate_costs(PlannerInfo *root, RelOptInfo *baserel,
 	 */
 	run_cost += seq_page_cost * pages;
 
+	/*
+	 * As in cost_seqscan(), a parallel scan is assumed to divide up the CPU
+	 * costs but not the I/O.
+	 */
 	*startup_cost = baserel->baserestrictcost.startup;
 	cpu_per_tuple = cpu_tuple_cost * 10 + baserel->baserestrictcost.per_tuple;
-	run_cost += cpu_per_tuple * ntuples;
+	run_cost += cpu_per_tuple * ntuples / parallel_divisor;
 	*total_cost = *startup_cost + run_cost;
 }
 
@@ -995,6 +1233,11 @@ estimate_costs(PlannerInfo *root, RelOptInfo *baserel,
  * We also count the total number of rows in the file and return it into
  * *totalrows.  Note that *totaldeadrows is always set to 0.
  *
+ * A large text-format file isn't read in full, though.  Like ANALYZE of a
+ * table, we read a random sample of targrows of its blocks, and sample the
+ * rows whose lines begin in those blocks; *totalrows is then extrapolated
+ * from the number of such rows.
+ *
  * Note that the returned list of rows is not always in order by physical
  * position in the file.  Therefore, correlation estimates derived later
  * may be meaningless, but it's OK because we don't use the estimates
@@ -1014,6 +1257,9 @@ file_acquire_sample_rows(Relation onerel, int elevel,
 	bool		found;
 	char	   *filename;
 	List	   *options;
+	struct stat stat_buf;
+	BlockNumber totalblocks;
+	FileRangeReader *reader = NULL;
 	CopyState	cstate;
 	ErrorContextCallback errcallback;
 	MemoryContext oldcontext = CurrentMemoryContext;
@@ -1029,10 +1275,25 @@ file_acquire_sample_rows(Relation onerel, int elevel,
 	/* Fetch options of foreign table */
 	fileGetOptions(RelationGetRelid(onerel), &filename, &options);
 
+	if (stat(filename, &stat_buf) < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not stat file \"%s\": %m",
+						filename)));
+	totalblocks = (stat_buf.st_size + (BLCKSZ - 1)) / BLCKSZ;
+
 	/*
-	 * Create CopyState from FDW options.
+	 * Create CopyState from FDW options, reading either a sample of the
+	 * file's blocks or the whole file.
 	 */
-	cstate = BeginCopyFrom(onerel, filename, false, NIL, options);
+	if (totalblocks > targrows && file_is_splittable(options))
+	{
+		reader = file_open_range_reader(filename, BLCKSZ);
+		BlockSampler_Init(&reader->bs, totalblocks, targrows, random());
+		cstate = BeginCopyFromReader(onerel, file_read_data, NIL, options);
+	}
+	else
+		cstate = BeginCopyFrom(onerel, filename, false, NIL, options);
 
 	/*
 	 * Use per-tuple memory context to prevent leak of memory used to read
@@ -1064,7 +1325,9 @@ file_acquire_sample_rows(Relation onerel, int elevel,
 		MemoryContextReset(tupcontext);
 		MemoryContextSwitchTo(tupcontext);
 
+		active_reader = reader;
 		found = NextCopyFrom(cstate, NULL, values, nulls, NULL);
+		active_reader = NULL;
 
 		MemoryContextSwitchTo(oldcontext);
 
@@ -1124,11 +1387,329 @@ file_acquire_sample_rows(Relation onerel, int elevel,
 	/*
 	 * Emit some interesting relation info
 	 */
-	ereport(elevel,
-			(errmsg("\"%s\": file contains %.0f rows; "
-					"%d rows in sample",
-					RelationGetRelationName(onerel),
-					*totalrows, numrows)));
+	if (reader)
+	{
+		double		nblocks = reader->nranges;
+		double		liverows = *totalrows;
+
+		file_close_range_reader(reader);
+
+		/* Extrapolate the number of rows seen to the whole file */
+		if (nblocks > 0)
+			*totalrows = floor((liverows / nblocks) * totalblocks + 0.5);
+
+		ereport(elevel,
+				(errmsg("\"%s\": scanned %.0f of %u blocks of file, "
+						"containing %.0f rows; "
+						"%d rows in sample, %.0f estimated total rows",
+						RelationGetRelationName(onerel),
+						nblocks, totalblocks,
+						liverows, numrows, *totalrows)));
+	}
+	else
+		ereport(elevel,
+				(errmsg("\"%s\": file contains %.0f rows; "
+						"%d rows in sample",
+						RelationGetRelationName(onerel),
+						*totalrows, numrows)));
 
 	return numrows;
 }
+
+/*
+ * Check whether a file read with the given COPY options can be split into
+ * ranges of bytes at line boundaries, that is, whether it is in text
+ * format.  In CSV format a quoted value can contain newlines, so we can't
+ * tell where a line begins without reading the file from the start, and
+ * binary format has no lines at all.
+ *
+ * In text format a newline within a value is escaped with a backslash, which
+ * we can recognize, unless the file is in one of the client-only encodings
+ * in which the second byte of a multibyte character can look like a
+ * backslash.  As in COPY, the file is in the client encoding unless the
+ * encoding option says otherwise.
+ *
+ * Note that the rows of a file read in ranges don't quite match those of a
+ * file read from the start if the file contains an end-of-data marker
+ * (backslash-period) before its end: data after the marker is not ignored.
+ */
+static bool
+file_is_splittable(List *options)
+{
+	int			encoding = pg_get_client_encoding();
+	ListCell   *lc;
+
+	foreach(lc, options)
+	{
+		DefElem    *def = (DefElem *) lfirst(lc);
+
+		if (strcmp(def->defname, "format") == 0)
+		{
+			if (strcmp(defGetString(def), "text") != 0)
+				return false;
+		}
+		else if (strcmp(def->defname, "encoding") == 0)
+			encoding = pg_char_to_encoding(defGetString(def));
+	}
+
+	return encoding >= 0 && !PG_ENCODING_IS_CLIENT_ONLY(encoding);
+}
+
+/*
+ * Open a file to be read in ranges of rangesize bytes.  The caller sets up
+ * where the ranges come from.
+ */
+static FileRangeReader *
+file_open_range_reader(const char *filename, off_t rangesize)
+{
+	FileRangeReader *reader;
+	struct stat stat_buf;
+
+	reader = (FileRangeReader *) palloc0(sizeof(FileRangeReader));
+	reader->filename = pstrdup(filename);
+	reader->rangesize = rangesize;
+
+	reader->fd = OpenTransientFile(reader->filename, O_RDONLY | PG_BINARY, 0);
+	if (reader->fd < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not open file \"%s\" for reading: %m",
+						filename)));
+	if (fstat(reader->fd, &stat_buf) < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not stat file \"%s\": %m",
+						filename)));
+	reader->filesize = stat_buf.st_size;
+
+	return reader;
+}
+
+/*
+ * Close a file opened by file_open_range_reader.
+ */
+static void
+file_close_range_reader(FileRangeReader *reader)
+{
+	if (CloseTransientFile(reader->fd))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not close file \"%s\": %m",
+						reader->filename)));
+	pfree(reader->filename);
+	pfree(reader);
+}
+
+/*
+ * Start reading the next range of the file that has a line beginning in it.
+ * Returns false if there are no more ranges.
+ */
+static bool
+file_next_range(FileRangeReader *reader)
+{
+	for (;;)
+	{
+		off_t		start;
+
+		if (reader->pscan)
+		{
+			uint64		chunk;
+
+			chunk = pg_atomic_fetch_add_u64(&reader->pscan->next_chunk, 1);
+			start = (off_t) chunk * reader->rangesize;
+			if (start >= reader->filesize)
+				return false;
+		}
+		else
+		{
+			if (!BlockSampler_HasMore(&reader->bs))
+				return false;
+			start = (off_t) BlockSampler_Next(&reader->bs) * reader->rangesize;
+		}
+		reader->nranges++;
+
+		reader->end = start + reader->rangesize;
+		reader->pos = file_find_line_start(reader, start);
+		if (reader->pos < reader->end && reader->pos < reader->filesize)
+			break;
+	}
+
+	if (lseek(reader->fd, reader->pos, SEEK_SET) < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not seek in file \"%s\": %m",
+						reader->filename)));
+	reader->in_range = true;
+	reader->finishing = false;
+	reader->nbackslashes = 0;
+
+	return true;
+}
+
+/*
+ * Read up to len bytes at offset off into buf.  Returns the number of bytes
+ * read, which is less than len only at the end of the file.
+ */
+static int
+file_pread(FileRangeReader *reader, char *buf, int len, off_t off)
+{
+	int			nread;
+
+	if (lseek(reader->fd, off, SEEK_SET) < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not seek in file \"%s\": %m",
+						reader->filename)));
+	nread = read(reader->fd, buf, len);
+	if (nread < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read file \"%s\": %m",
+						reader->filename)));
+	return nread;
+}
+
+/*
+ * Find the offset of the first line that begins at or after offset start,
+ * or the file size if there is none.
+ */
+static off_t
+file_find_line_start(FileRangeReader *reader, off_t start)
+{
+	char		buf[BLCKSZ];
+	off_t		lookback;
+	int			nread;
+	int			i;
+
+	if (start == 0)
+		return 0;
+
+	/*
+	 * A line begins at start if the byte before it ends a line, so search
+	 * from there.  But to tell whether that byte is an escaped newline, we
+	 * must first count the backslashes just before it.
+	 */
+	reader->nbackslashes = 0;
+	lookback = start - 1;
+	while (lookback > 0)
+	{
+		off_t		from = Max(lookback - (off_t) sizeof(buf), 0);
+
+		nread = file_pread(reader, buf, lookback - from, from);
+		for (i = nread - 1; i >= 0 && buf[i] == '\\'; i--)
+			reader->nbackslashes++;
+		if (i >= 0 || nread == 0)
+			break;
+		lookback = from;
+	}
+
+	for (start = start - 1;; start += nread)
+	{
+		nread = file_pread(reader, buf, sizeof(buf), start);
+		if (nread == 0)
+			return reader->filesize;
+		i = file_find_line_end(reader, buf, nread);
+		if (i >= 0)
+			return start + i + 1;
+	}
+}
+
+/*
+ * Find the newline ending a line in buf[0..len-1], which continues the data
+ * last searched by file_find_line_end, and return its index, or -1 if there
+ * is none.
+ */
+static int
+file_find_line_end(FileRangeReader *reader, char *buf, int len)
+{
+	int			i;
+
+	for (i = 0; i < len; i++)
+	{
+		if (buf[i] == '\n' && reader->nbackslashes % 2 == 0)
+			return i;
+		if (buf[i] == '\\')
+			reader->nbackslashes++;
+		else
+			reader->nbackslashes = 0;
+	}
+	return -1;
+}
+
+/*
+ * Data source callback for the COPY code reading active_reader.
+ *
+ * We return the lines beginning in each range in turn: first the bytes up to
+ * just before the end of the range, then, however far it extends past the
+ * end, the rest of the line containing the last byte.
+ */
+static int
+file_read_data(void *outbuf, int minread, int maxread)
+{
+	FileRangeReader *reader = active_reader;
+	char	   *buf = (char *) outbuf;
+	int			bytesread = 0;
+
+	Assert(reader != NULL);
+
+	while (bytesread < minread)
+	{
+		off_t		want;
+		int			nread;
+
+		if (!reader->in_range && !file_next_range(reader))
+			break;
+
+		want = maxread - bytesread;
+		if (!reader->finishing)
+		{
+			if (reader->pos >= reader->end - 1)
+			{
+				reader->finishing = true;
+				continue;
+			}
+			want = Min(want, reader->end - 1 - reader->pos);
+		}
+
+		nread = read(reader->fd, buf + bytesread, (size_t) want);
+		if (nread < 0)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not read file \"%s\": %m",
+							reader->filename)));
+		if (nread == 0)
+		{
+			/* end of file ends the range */
+			reader->in_range = false;
+			continue;
+		}
+
+		if (reader->finishing)
+		{
+			int			i = file_find_line_end(reader, buf + bytesread, nread);
+
+			if (i >= 0)
+			{
+				nread = i + 1;
+				reader->in_range = false;
+			}
+		}
+		else
+		{
+			/* Keep count of the backslashes before the next byte */
+			int			i = nread - 1;
+
+			while (i >= 0 && buf[bytesread + i] == '\\')
+				i--;
+			if (i < 0)
+				reader->nbackslashes += nread;
+			else
+				reader->nbackslashes = nread - 1 - i;
+		}
+
+		reader->pos += nread;
+		bytesread += nread;
+	}
+
+	return bytesread;
+}
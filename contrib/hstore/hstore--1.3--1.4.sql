@@ -0,0 +1,29 @@
+/* contrib/hstore/hstore--1.3--1.4.sql */
+
+-- complain if script is sourced in psql, rather than via ALTER EXTENSION
+\echo Use "ALTER EXTENSION hstore UPDATE TO '1.4'" to load this file. \quit
+
+CREATE FUNCTION gin_extract_hstore_pair(internal, internal)
+RETURNS internal
+AS 'MODULE_PATHNAME'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE FUNCTION gin_extract_hstore_pair_query(internal, internal, int2, internal, internal, internal, internal)
+RETURNS internal
+AS 'MODULE_PATHNAME'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE FUNCTION gin_consistent_hstore_pair(internal, int2, internal, int4, internal, internal, internal, internal)
+RETURNS bool
+AS 'MODULE_PATHNAME'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OPERATOR CLASS gin_hstore_pair_ops
+FOR TYPE hstore USING gin
+AS
+	OPERATOR        7       @>,
+	FUNCTION        1       byteacmp(bytea,bytea),
+	FUNCTION        2       gin_extract_hstore_pair(internal, internal),
+	FUNCTION        3       gin_extract_hstore_pair_query(internal, internal, int2, internal, internal, internal, internal),
+	FUNCTION        4       gin_consistent_hstore_pair(internal, int2, internal, int4, internal, internal, internal, internal),
+	STORAGE         bytea;
@@ -4,6 +4,7 @@
 #include "postgres.h"
 
 #include "access/gin.h"
+#include "access/hash.h"
 #include "access/stratnum.h"
 #include "catalog/pg_type.h"
 
@@ -208,3 +209,141 @@ gin_consistent_hstore(PG_FUNCTION_ARGS)
 
 	PG_RETURN_BOOL(res);
 }
+
+
+/*
+ * gin_hstore_pair_ops indexes each key/value pair as a single entry, so that
+ * @> can be answered from the index alone, without the recheck that
+ * gin_hstore_ops needs to match up keys and values.  It doesn't support the
+ * key existence operators.
+ *
+ * The entries are bytea values: PAIRFLAG followed by the key length, the key
+ * and the value, or PAIRNULLFLAG followed by the key length and the key for a
+ * null value.  Pairs too long to make reasonable index entries are replaced
+ * by PAIRHASHFLAG and a hash of what would otherwise be stored; those make
+ * the search lossy.
+ */
+#define PAIRFLAG		'P'
+#define PAIRNULLFLAG	'N'
+#define PAIRHASHFLAG	'H'
+
+#define PAIR_MAX_ITEM_LEN	256
+
+PG_FUNCTION_INFO_V1(gin_extract_hstore_pair);
+
+/* Build the index entry for the pair at index i of hs */
+static bytea *
+makepairitem(HEntry *hsent, char *ptr, int i)
+{
+	bytea	   *item;
+	uint32		keylen = HS_KEYLEN(hsent, i);
+	uint32		vallen = HS_VALISNULL(hsent, i) ? 0 : HS_VALLEN(hsent, i);
+	Size		len = sizeof(uint32) + keylen + vallen;
+	char	   *p;
+
+	item = (bytea *) palloc(VARHDRSZ + 1 + len);
+	p = VARDATA(item);
+	*p++ = HS_VALISNULL(hsent, i) ? PAIRNULLFLAG : PAIRFLAG;
+
+	/* the key and value are adjacent in the hstore */
+	memcpy(p, &keylen, sizeof(uint32));
+	memcpy(p + sizeof(uint32), HS_KEY(hsent, ptr, i), keylen + vallen);
+
+	if (len > PAIR_MAX_ITEM_LEN)
+	{
+		uint32		hash = DatumGetUInt32(hash_any((unsigned char *) p, len));
+
+		*VARDATA(item) = PAIRHASHFLAG;
+		memcpy(p, &hash, sizeof(uint32));
+		len = sizeof(uint32);
+	}
+
+	SET_VARSIZE(item, VARHDRSZ + 1 + len);
+
+	return item;
+}
+
+Datum
+gin_extract_hstore_pair(PG_FUNCTION_ARGS)
+{
+	HStore	   *hs = PG_GETARG_HS(0);
+	int32	   *nentries = (int32 *) PG_GETARG_POINTER(1);
+	Datum	   *entries = NULL;
+	HEntry	   *hsent = ARRPTR(hs);
+	char	   *ptr = STRPTR(hs);
+	int			count = HS_COUNT(hs);
+	int			i;
+
+	*nentries = count;
+	if (count)
+		entries = (Datum *) palloc(sizeof(Datum) * count);
+
+	for (i = 0; i < count; ++i)
+		entries[i] = PointerGetDatum(makepairitem(hsent, ptr, i));
+
+	PG_RETURN_POINTER(entries);
+}
+
+PG_FUNCTION_INFO_V1(gin_extract_hstore_pair_query);
+
+Datum
+gin_extract_hstore_pair_query(PG_FUNCTION_ARGS)
+{
+	int32	   *nentries = (int32 *) PG_GETARG_POINTER(1);
+	StrategyNumber strategy = PG_GETARG_UINT16(2);
+	int32	   *searchMode = (int32 *) PG_GETARG_POINTER(6);
+	Datum	   *entries;
+
+	if (strategy != HStoreContainsStrategyNumber)
+		elog(ERROR, "unrecognized strategy number: %d", strategy);
+
+	/* Query is an hstore, so just apply gin_extract_hstore_pair... */
+	entries = (Datum *)
+		DatumGetPointer(DirectFunctionCall2(gin_extract_hstore_pair,
+											PG_GETARG_DATUM(0),
+											PointerGetDatum(nentries)));
+	/* ... except that "contains {}" requires a full index scan */
+	if (entries == NULL)
+		*searchMode = GIN_SEARCH_MODE_ALL;
+
+	PG_RETURN_POINTER(entries);
+}
+
+PG_FUNCTION_INFO_V1(gin_consistent_hstore_pair);
+
+Datum
+gin_consistent_hstore_pair(PG_FUNCTION_ARGS)
+{
+	bool	   *check = (bool *) PG_GETARG_POINTER(0);
+	StrategyNumber strategy = PG_GETARG_UINT16(1);
+
+	/* HStore	   *query = PG_GETARG_HS(2); */
+	int32		nkeys = PG_GETARG_INT32(3);
+
+	/* Pointer	   *extra_data = (Pointer *) PG_GETARG_POINTER(4); */
+	bool	   *recheck = (bool *) PG_GETARG_POINTER(5);
+	Datum	   *queryKeys = (Datum *) PG_GETARG_POINTER(6);
+	bool		res = true;
+	int32		i;
+
+	if (strategy != HStoreContainsStrategyNumber)
+		elog(ERROR, "unrecognized strategy number: %d", strategy);
+
+	/*
+	 * All the pairs of the query must be present.  That is an exact result,
+	 * unless some of them were hashed.
+	 */
+	*recheck = false;
+	for (i = 0; i < nkeys; i++)
+	{
+		if (!check[i])
+		{
+			res = false;
+			break;
+		}
+		if (*VARDATA_ANY(DatumGetPointer(queryKeys[i])) == PAIRHASHFLAG)
+			*recheck = true;
+	}
+
+	PG_RETURN_BOOL(res);
+}
@@ -576,9 +576,14 @@ hstore_slice_to_array(PG_FUNCTION_ARGS)
 	ArrayType  *aout;
 	Datum	   *key_datums;
 	bool	   *key_nulls;
-	Datum	   *out_datums;
-	bool	   *out_nulls;
+	int		   *idxs;
 	int			key_count;
+	int			ndim;
+	Size		nbytes;
+	int32		dataoffset;
+	bool		hasnulls;
+	char	   *p;
+	bits8	   *bitmap;
 	int			i;
 
 	deconstruct_array(key_array,
@@ -591,8 +596,10 @@ hstore_slice_to_array(PG_FUNCTION_ARGS)
 		PG_RETURN_POINTER(aout);
 	}
 
-	out_datums = palloc(sizeof(Datum) * key_count);
-	out_nulls = palloc(sizeof(bool) * key_count);
+	/* look up the values, and add up the space they need */
+	idxs = palloc(sizeof(int) * key_count);
+	nbytes = 0;
+	hasnulls = false;
 
 	for (i = 0; i < key_count; ++i)
 	{
@@ -606,23 +613,66 @@ hstore_slice_to_array(PG_FUNCTION_ARGS)
 
 		if (idx < 0 || HS_VALISNULL(entries, idx))
 		{
-			out_nulls[i] = true;
-			out_datums[i] = (Datum) 0;
+			idxs[i] = -1;
+			hasnulls = true;
 		}
 		else
 		{
-			out_datums[i] = PointerGetDatum(
-						  cstring_to_text_with_len(HS_VAL(entries, ptr, idx),
-												   HS_VALLEN(entries, idx)));
-			out_nulls[i] = false;
+			idxs[i] = idx;
+			nbytes += INTALIGN(VARHDRSZ + HS_VALLEN(entries, idx));
+			if (!AllocSizeIsValid(nbytes))
+				ereport(ERROR,
+						(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+						 errmsg("array size exceeds the maximum allowed (%d)",
+								(int) MaxAllocSize)));
 		}
 	}
 
-	aout = construct_md_array(out_datums, out_nulls,
-							  ARR_NDIM(key_array),
-							  ARR_DIMS(key_array),
-							  ARR_LBOUND(key_array),
-							  TEXTOID, -1, false, 'i');
+	/*
+	 * Build the result array directly from the values in the hstore, rather
+	 * than making a text datum of each and passing them to
+	 * construct_md_array(), which would copy them all again.  This follows
+	 * the layout construct_md_array() produces.
+	 */
+	ndim = ARR_NDIM(key_array);
+	if (hasnulls)
+	{
+		dataoffset = ARR_OVERHEAD_WITHNULLS(ndim, key_count);
+		nbytes += dataoffset;
+	}
+	else
+	{
+		dataoffset = 0;			/* marker for no null bitmap */
+		nbytes += ARR_OVERHEAD_NONULLS(ndim);
+	}
+	aout = (ArrayType *) palloc0(nbytes);
+	SET_VARSIZE(aout, nbytes);
+	aout->ndim = ndim;
+	aout->dataoffset = dataoffset;
+	aout->elemtype = TEXTOID;
+	memcpy(ARR_DIMS(aout), ARR_DIMS(key_array), ndim * sizeof(int));
+	memcpy(ARR_LBOUND(aout), ARR_LBOUND(key_array), ndim * sizeof(int));
+
+	p = ARR_DATA_PTR(aout);
+	bitmap = ARR_NULLBITMAP(aout);
+
+	for (i = 0; i < key_count; ++i)
+	{
+		int			idx = idxs[i];
+		int			vallen;
+
+		/* a null element just leaves its bitmap bit zero */
+		if (idx < 0)
+			continue;
+
+		vallen = HS_VALLEN(entries, idx);
+		SET_VARSIZE(p, VARHDRSZ + vallen);
+		memcpy(VARDATA(p), HS_VAL(entries, ptr, idx), vallen);
+		p += INTALIGN(VARHDRSZ + vallen);
+
+		if (bitmap)
+			bitmap[i / BITS_PER_BYTE] |= 1 << (i % BITS_PER_BYTE);
+	}
 
 	PG_RETURN_POINTER(aout);
 }
@@ -639,7 +689,10 @@ hstore_slice_to_hstore(PG_FUNCTION_ARGS)
 	HStore	   *out;
 	int			nkeys;
 	Pairs	   *key_pairs = hstoreArrayToPairs(key_array, &nkeys);
-	Pairs	   *out_pairs;
+	int		   *idxs;
+	HEntry	   *ed;
+	char	   *bufd,
+			   *pd;
 	int			bufsiz;
 	int			lastidx = 0;
 	int			i;
@@ -652,7 +705,7 @@ hstore_slice_to_hstore(PG_FUNCTION_ARGS)
 	}
 
 	/* hstoreArrayToPairs() checked overflow */
-	out_pairs = palloc(sizeof(Pairs) * nkeys);
+	idxs = palloc(sizeof(int) * nkeys);
 	bufsiz = 0;
 
 	/*
@@ -669,22 +722,35 @@ hstore_slice_to_hstore(PG_FUNCTION_ARGS)
 
 		if (idx >= 0)
 		{
-			out_pairs[out_count].key = key_pairs[i].key;
-			bufsiz += (out_pairs[out_count].keylen = key_pairs[i].keylen);
-			out_pairs[out_count].val = HS_VAL(entries, ptr, idx);
-			bufsiz += (out_pairs[out_count].vallen = HS_VALLEN(entries, idx));
-			out_pairs[out_count].isnull = HS_VALISNULL(entries, idx);
-			out_pairs[out_count].needfree = false;
-			++out_count;
+			idxs[out_count++] = idx;
+			bufsiz += HS_KEYLEN(entries, idx) + HS_VALLEN(entries, idx);
 		}
 	}
 
+	/* if every key was asked for, the result is the input itself */
+	if (out_count == HS_COUNT(hs))
+		PG_RETURN_POINTER(hs);
+
 	/*
-	 * we don't use uniquePairs here because we know that the pairs list is
-	 * already sorted and uniq'ed.
+	 * The pairs found are in the order of hs, so they can be copied straight
+	 * from it, each key and value with a single memcpy, rather than going
+	 * through a Pairs array and hstorePairs().
 	 */
+	out = palloc(CALCDATASIZE(out_count, bufsiz));
+	HS_SETCOUNT(out, out_count);
+	ed = ARRPTR(out);
+	bufd = pd = STRPTR(out);
 
-	out = hstorePairs(out_pairs, out_count, bufsiz);
+	for (i = 0; i < out_count; ++i)
+	{
+		int			idx = idxs[i];
+
+		HS_COPYITEM(ed, bufd, pd,
+					HS_KEY(entries, ptr, idx), HS_KEYLEN(entries, idx),
+					HS_VALLEN(entries, idx), HS_VALISNULL(entries, idx));
+	}
+
+	HS_FINALIZE(out, out_count, bufd, pd);
 
 	PG_RETURN_POINTER(out);
 }
@@ -845,13 +911,13 @@ hstore_to_matrix(PG_FUNCTION_ARGS)
  * Common initialization function for the various set-returning
  * funcs. fcinfo is only passed if the function is to return a
  * composite; it will be used to look up the return tupledesc.
- * we stash a copy of the hstore in the multi-call context in
- * case it was originally toasted. (At least I assume that's why;
- * there was no explanatory comment in the original code. --AG)
+ * we need the hstore to survive in the multi-call context, so it is
+ * detoasted there; only a value that wasn't toasted to begin with
+ * has to be copied.
  */
 
 static void
-setup_firstcall(FuncCallContext *funcctx, HStore *hs,
+setup_firstcall(FuncCallContext *funcctx, Datum hsdatum,
 				FunctionCallInfoData *fcinfo)
 {
 	MemoryContext oldcontext;
@@ -859,8 +925,14 @@ setup_firstcall(FuncCallContext *funcctx, HStore *hs,
 
 	oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
 
-	st = (HStore *) palloc(VARSIZE(hs));
-	memcpy(st, hs, VARSIZE(hs));
+	st = DatumGetHStoreP(hsdatum);
+	if ((Pointer) st == DatumGetPointer(hsdatum))
+	{
+		HStore	   *hs = st;
+
+		st = (HStore *) palloc(VARSIZE(hs));
+		memcpy(st, hs, VARSIZE(hs));
+	}
 
 	funcctx->user_fctx = (void *) st;
 
@@ -889,9 +961,8 @@ hstore_skeys(PG_FUNCTION_ARGS)
 
 	if (SRF_IS_FIRSTCALL())
 	{
-		hs = PG_GETARG_HS(0);
 		funcctx = SRF_FIRSTCALL_INIT();
-		setup_firstcall(funcctx, hs, NULL);
+		setup_firstcall(funcctx, PG_GETARG_DATUM(0), NULL);
 	}
 
 	funcctx = SRF_PERCALL_SETUP();
@@ -923,9 +994,8 @@ hstore_svals(PG_FUNCTION_ARGS)
 
 	if (SRF_IS_FIRSTCALL())
 	{
-		hs = PG_GETARG_HS(0);
 		funcctx = SRF_FIRSTCALL_INIT();
-		setup_firstcall(funcctx, hs, NULL);
+		setup_firstcall(funcctx, PG_GETARG_DATUM(0), NULL);
 	}
 
 	funcctx = SRF_PERCALL_SETUP();
@@ -1028,9 +1098,8 @@ hstore_each(PG_FUNCTION_ARGS)
 
 	if (SRF_IS_FIRSTCALL())
 	{
-		hs = PG_GETARG_HS(0);
 		funcctx = SRF_FIRSTCALL_INIT();
-		setup_firstcall(funcctx, hs, fcinfo);
+		setup_firstcall(funcctx, PG_GETARG_DATUM(0), fcinfo);
 	}
 
 	funcctx = SRF_PERCALL_SETUP();
@@ -108,6 +108,8 @@ bool		inner_int_overlap(ArrayType *a, ArrayType *b);
 bool		inner_int_contains(ArrayType *a, ArrayType *b);
 ArrayType  *inner_int_union(ArrayType *a, ArrayType *b);
 ArrayType  *inner_int_inter(ArrayType *a, ArrayType *b);
+int			inner_int_union_size(ArrayType *a, ArrayType *b);
+int			inner_int_inter_size(ArrayType *a, ArrayType *b);
 void		rt__int_size(ArrayType *a, float *size);
 void		gensign(BITVEC sign, int *a, int len);
 
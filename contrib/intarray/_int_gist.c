@@ -287,16 +287,13 @@ g_int_penalty(PG_FUNCTION_ARGS)
 	GISTENTRY  *origentry = (GISTENTRY *) PG_GETARG_POINTER(0);
 	GISTENTRY  *newentry = (GISTENTRY *) PG_GETARG_POINTER(1);
 	float	   *result = (float *) PG_GETARG_POINTER(2);
-	ArrayType  *ud;
-	float		tmp1,
-				tmp2;
+	ArrayType  *orig = (ArrayType *) DatumGetPointer(origentry->key);
+	float		tmp;
 
-	ud = inner_int_union((ArrayType *) DatumGetPointer(origentry->key),
-						 (ArrayType *) DatumGetPointer(newentry->key));
-	rt__int_size(ud, &tmp1);
-	rt__int_size((ArrayType *) DatumGetPointer(origentry->key), &tmp2);
-	*result = tmp1 - tmp2;
-	pfree(ud);
+	/* the union is only counted, not constructed */
+	rt__int_size(orig, &tmp);
+	*result = (float) inner_int_union_size(orig,
+						(ArrayType *) DatumGetPointer(newentry->key)) - tmp;
 
 	PG_RETURN_POINTER(result);
 }
@@ -370,10 +367,7 @@ g_int_picksplit(PG_FUNCTION_ARGS)
 			   *datum_beta;
 	ArrayType  *datum_l,
 			   *datum_r;
-	ArrayType  *union_d,
-			   *union_dl,
-			   *union_dr;
-	ArrayType  *inter_d;
+	ArrayType  *union_d;
 	bool		firsttime;
 	float		size_alpha,
 				size_beta,
@@ -410,16 +404,10 @@ g_int_picksplit(PG_FUNCTION_ARGS)
 			datum_beta = GETENTRY(entryvec, j);
 
 			/* compute the wasted space by unioning these guys */
-			/* size_waste = size_union - size_inter; */
-			union_d = inner_int_union(datum_alpha, datum_beta);
-			rt__int_size(union_d, &size_union);
-			inter_d = inner_int_inter(datum_alpha, datum_beta);
-			rt__int_size(inter_d, &size_inter);
+			size_union = (float) inner_int_union_size(datum_alpha, datum_beta);
+			size_inter = (float) inner_int_inter_size(datum_alpha, datum_beta);
 			size_waste = size_union - size_inter;
 
-			pfree(union_d);
-			pfree(inter_d);
-
 			/*
 			 * are these a more promising split that what we've already seen?
 			 */
@@ -461,12 +449,8 @@ g_int_picksplit(PG_FUNCTION_ARGS)
 	{
 		costvector[i - 1].pos = i;
 		datum_alpha = GETENTRY(entryvec, i);
-		union_d = inner_int_union(datum_l, datum_alpha);
-		rt__int_size(union_d, &size_alpha);
-		pfree(union_d);
-		union_d = inner_int_union(datum_r, datum_alpha);
-		rt__int_size(union_d, &size_beta);
-		pfree(union_d);
+		size_alpha = (float) inner_int_union_size(datum_l, datum_alpha);
+		size_beta = (float) inner_int_union_size(datum_r, datum_alpha);
 		costvector[i - 1].cost = Abs((size_alpha - size_l) - (size_beta - size_r));
 	}
 	qsort((void *) costvector, maxoff, sizeof(SPLITCOST), comparecost);
@@ -507,28 +491,29 @@ g_int_picksplit(PG_FUNCTION_ARGS)
 			continue;
 		}
 
-		/* okay, which page needs least enlargement? */
+		/*
+		 * okay, which page needs least enlargement?  Only the union with the
+		 * page we pick is constructed.
+		 */
 		datum_alpha = GETENTRY(entryvec, i);
-		union_dl = inner_int_union(datum_l, datum_alpha);
-		union_dr = inner_int_union(datum_r, datum_alpha);
-		rt__int_size(union_dl, &size_alpha);
-		rt__int_size(union_dr, &size_beta);
+		size_alpha = (float) inner_int_union_size(datum_l, datum_alpha);
+		size_beta = (float) inner_int_union_size(datum_r, datum_alpha);
 
 		/* pick which page to add it to */
 		if (size_alpha - size_l < size_beta - size_r + WISH_F(v->spl_nleft, v->spl_nright, 0.01))
 		{
+			union_d = inner_int_union(datum_l, datum_alpha);
 			pfree(datum_l);
-			pfree(union_dr);
-			datum_l = union_dl;
+			datum_l = union_d;
 			size_l = size_alpha;
 			*left++ = i;
 			v->spl_nleft++;
 		}
 		else
 		{
+			union_d = inner_int_union(datum_r, datum_alpha);
 			pfree(datum_r);
-			pfree(union_dl);
-			datum_r = union_dr;
+			datum_r = union_d;
 			size_r = size_beta;
 			*right++ = i;
 			v->spl_nright++;
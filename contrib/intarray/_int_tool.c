@@ -7,6 +7,52 @@
 
 #include "_int.h"
 
+/*
+ * SSE2 is part of the x86-64 baseline, so it can be used without a runtime
+ * check.
+ */
+#if defined(__x86_64__) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define USE_SSE2
+#endif
+
+
+/*
+ * Return the index of the first element at or after d[i] that is not less
+ * than val, in the sorted array d of n elements.
+ *
+ * This is the step by which the merge loops below advance over the elements
+ * of one array that are missing from the other.  With SSE2, it compares four
+ * elements at a time, which pays off when the arrays differ in size, as is
+ * typical of a query against the keys of a GiST index.  It advances over
+ * exactly the same elements as the plain loop would, so the merge loops work
+ * the same whether or not their input is unique-ified.
+ */
+static inline int
+int_skip_less(const int *d, int n, int i, int val)
+{
+#ifdef USE_SSE2
+	__m128i		vval = _mm_set1_epi32(val);
+
+	while (i + 4 <= n)
+	{
+		__m128i		blk = _mm_loadu_si128((const __m128i *) (d + i));
+		int			mask;
+
+		/*
+		 * The lanes less than val form a prefix of the block, since it's
+		 * sorted, so the mask is 0, 1, 3, 7 or 15.
+		 */
+		mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(vval, blk)));
+		if (mask != 0xF)
+			return i + (mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1);
+		i += 4;
+	}
+#endif
+	while (i < n && d[i] < val)
+		i++;
+	return i;
+}
 
 /* arguments are assumed sorted & unique-ified */
 bool
@@ -29,7 +75,7 @@ inner_int_contains(ArrayType *a, ArrayType *b)
 	while (i < na && j < nb)
 	{
 		if (da[i] < db[j])
-			i++;
+			i = int_skip_less(da, na, i, db[j]);
 		else if (da[i] == db[j])
 		{
 			n++;
@@ -63,11 +109,11 @@ inner_int_overlap(ArrayType *a, ArrayType *b)
 	while (i < na && j < nb)
 	{
 		if (da[i] < db[j])
-			i++;
+			i = int_skip_less(da, na, i, db[j]);
 		else if (da[i] == db[j])
 			return TRUE;
 		else
-			j++;
+			j = int_skip_less(db, nb, j, da[i]);
 	}
 
 	return FALSE;
@@ -130,45 +176,110 @@ inner_int_union(ArrayType *a, ArrayType *b)
 	return r;
 }
 
-ArrayType *
-inner_int_inter(ArrayType *a, ArrayType *b)
+/*
+ * Number of elements of inner_int_union(a, b), without constructing it.
+ * Arguments are assumed sorted.
+ */
+int
+inner_int_union_size(ArrayType *a, ArrayType *b)
 {
-	ArrayType  *r;
 	int			na,
 				nb;
 	int		   *da,
-			   *db,
-			   *dr;
+			   *db;
 	int			i,
 				j,
-				k;
+				n,
+				last;
 
-	if (ARRISEMPTY(a) || ARRISEMPTY(b))
-		return new_intArrayType(0);
+	CHECKARRVALID(a);
+	CHECKARRVALID(b);
 
 	na = ARRNELEMS(a);
 	nb = ARRNELEMS(b);
 	da = ARRPTR(a);
 	db = ARRPTR(b);
-	r = new_intArrayType(Min(na, nb));
-	dr = ARRPTR(r);
+
+	/* count the distinct values of the merged arrays */
+	i = j = n = 0;
+	last = 0;
+	while (i < na || j < nb)
+	{
+		int			val;
+
+		if (j >= nb || (i < na && da[i] < db[j]))
+			val = da[i++];
+		else if (i >= na || db[j] < da[i])
+			val = db[j++];
+		else
+		{
+			val = da[i++];
+			j++;
+		}
+
+		if (n == 0 || val != last)
+		{
+			n++;
+			last = val;
+		}
+	}
+
+	return n;
+}
+
+/*
+ * Compute the intersection of the sorted arrays da and db into dr, which
+ * must have room for Min(na, nb) elements, and return its number of
+ * elements.  If dr is NULL, only the count is returned.
+ */
+static int
+inner_int_inter_internal(int *da, int na, int *db, int nb, int *dr)
+{
+	int			i,
+				j,
+				k;
+	int			last = 0;
 
 	i = j = k = 0;
 	while (i < na && j < nb)
 	{
 		if (da[i] < db[j])
-			i++;
+			i = int_skip_less(da, na, i, db[j]);
 		else if (da[i] == db[j])
 		{
-			if (k == 0 || dr[k - 1] != db[j])
-				dr[k++] = db[j];
+			if (k == 0 || last != db[j])
+			{
+				last = db[j];
+				if (dr)
+					dr[k] = last;
+				k++;
+			}
 			i++;
 			j++;
 		}
 		else
-			j++;
+			j = int_skip_less(db, nb, j, da[i]);
 	}
 
+	return k;
+}
+
+ArrayType *
+inner_int_inter(ArrayType *a, ArrayType *b)
+{
+	ArrayType  *r;
+	int			na,
+				nb;
+	int			k;
+
+	if (ARRISEMPTY(a) || ARRISEMPTY(b))
+		return new_intArrayType(0);
+
+	na = ARRNELEMS(a);
+	nb = ARRNELEMS(b);
+	r = new_intArrayType(Min(na, nb));
+	k = inner_int_inter_internal(ARRPTR(a), na, ARRPTR(b), nb, ARRPTR(r));
+
 	if (k == 0)
 	{
 		pfree(r);
@@ -178,6 +289,20 @@ inner_int_inter(ArrayType *a, ArrayType *b)
 		return resize_intArrayType(r, k);
 }
 
+/*
+ * Number of elements of inner_int_inter(a, b), without constructing it.
+ * Arguments are assumed sorted.
+ */
+int
+inner_int_inter_size(ArrayType *a, ArrayType *b)
+{
+	if (ARRISEMPTY(a) || ARRISEMPTY(b))
+		return 0;
+
+	return inner_int_inter_internal(ARRPTR(a), ARRNELEMS(a),
+									ARRPTR(b), ARRNELEMS(b), NULL);
+}
+
 void
 rt__int_size(ArrayType *a, float *size)
 {
@@ -9,15 +9,15 @@ use Time::HiRes qw( usleep ualarm gettimeofday tv_interval );
 use Getopt::Std;
 
 my %opt;
-getopts('d:b:s:veorauc', \%opt);
+getopts('d:b:s:veoraucwi', \%opt);
 
 if (!(scalar %opt && defined $opt{s}))
 {
 	print <<EOT;
 Usage:
-$0 -d DATABASE -s SECTIONS [-b NUMBER] [-v] [-e] [-o] [-r] [-a] [-u]
+$0 -d DATABASE -s SECTIONS [-b NUMBER] [-v] [-e] [-o] [-r] [-a] [-u] [-c] [-i] [-w]
 -d DATABASE	-DATABASE
--b NUMBER	-number of repeats
+-b NUMBER	-number of repeats, reported with the fastest and median time
 -s SECTIONS	-sections, format	sid1[,sid2[,sid3[...]]]]
 -v		-verbose (show SQL)
 -e		-show explain
@@ -26,6 +26,8 @@ $0 -d DATABASE -s SECTIONS [-b NUMBER] [-v] [-e] [-o] [-r] [-a] [-u]
 -o		-show output
 -u		-unique
 -c		-count
+-i		-compute the intersection with the sections (implies -r)
+-w		-run the query once before timing, to warm up the cache
 
 EOT
 	exit;
@@ -39,6 +41,8 @@ my @where;
 
 $table{message} = 1;
 
+$opt{r} = 1 if $opt{i};
+
 if ($opt{a})
 {
 	if ($opt{r})
@@ -70,7 +74,11 @@ else
 }
 
 my $outf;
-if ($opt{c})
+if ($opt{i})
+{
+	$outf = "message.mid, message.sections & '{$opt{s}}' as sections";
+}
+elsif ($opt{c})
 {
 	$outf =
 	  ($opt{u}) ? 'count( distinct message.mid )' : 'count( message.mid )';
@@ -95,17 +103,23 @@ if ($opt{e})
 	$dbi->do("explain $sql");
 }
 
-my $t0    = [gettimeofday];
+exec_sql($dbi, $sql) if $opt{w};
+
 my $count = 0;
-my $b     = $opt{b};
-$b ||= 1;
+my $loops = $opt{b};
+$loops ||= 1;
 my @a;
-foreach (1 .. $b)
+my @times;
+foreach (1 .. $loops)
 {
+	my $t0 = [gettimeofday];
 	@a = exec_sql($dbi, $sql);
+	push @times, tv_interval($t0, [gettimeofday]);
 	$count = $#a;
 }
-my $elapsed = tv_interval($t0, [gettimeofday]);
+my $elapsed = 0;
+$elapsed += $_ foreach @times;
+@times = sort { $a <=> $b } @times;
 if ($opt{o})
 {
 	foreach (@a)
@@ -115,8 +129,10 @@ if ($opt{o})
 }
 print sprintf(
 	"total: %.02f sec; number: %d; for one: %.03f sec; found %d docs\n",
-	$elapsed, $b, $elapsed / $b,
+	$elapsed, $loops, $elapsed / $loops,
 	$count + 1);
+print sprintf("fastest: %.03f sec; median: %.03f sec\n",
+	$times[0], $times[ $#times / 2 ]);
 $dbi->disconnect;
 
 sub exec_sql
@@ -0,0 +1,122 @@
+/* contrib/logicalrep/logicalrep--1.0.sql */
+
+-- complain if script is sourced in psql, rather than via CREATE EXTENSION
+\echo Use "CREATE EXTENSION logicalrep" to load this file. \quit
+
+--
+-- Publisher side.  The output plugin reads these tables while decoding,
+-- so they must be readable under historic snapshots.
+--
+CREATE TABLE publication (
+    pubname name PRIMARY KEY,
+    all_tables boolean NOT NULL DEFAULT false
+) WITH (user_catalog_table = true);
+
+CREATE TABLE publication_rel (
+    pubname name NOT NULL REFERENCES publication ON DELETE CASCADE,
+    relid regclass NOT NULL,
+    PRIMARY KEY (pubname, relid)
+) WITH (user_catalog_table = true);
+
+SELECT pg_catalog.pg_extension_config_dump('publication', '');
+SELECT pg_catalog.pg_extension_config_dump('publication_rel', '');
+
+CREATE FUNCTION publication_changed()
+RETURNS trigger
+AS 'MODULE_PATHNAME', 'logicalrep_publication_changed'
+LANGUAGE C;
+
+CREATE TRIGGER publication_changed
+AFTER INSERT OR UPDATE OR DELETE OR TRUNCATE ON publication
+FOR EACH STATEMENT EXECUTE PROCEDURE publication_changed();
+
+CREATE TRIGGER publication_changed
+AFTER INSERT OR UPDATE OR DELETE OR TRUNCATE ON publication_rel
+FOR EACH STATEMENT EXECUTE PROCEDURE publication_changed();
+
+CREATE FUNCTION create_publication(pubname name,
+                                   all_tables boolean DEFAULT false)
+RETURNS void
+LANGUAGE sql STRICT AS $$
+  INSERT INTO logicalrep.publication VALUES ($1, $2)
+$$;
+
+CREATE FUNCTION drop_publication(pubname name)
+RETURNS void
+LANGUAGE sql STRICT AS $$
+  DELETE FROM logicalrep.publication WHERE pubname = $1
+$$;
+
+CREATE FUNCTION publication_add_table(pubname name, relation regclass)
+RETURNS void
+AS 'MODULE_PATHNAME', 'logicalrep_publication_add_table'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION publication_remove_table(pubname name, relation regclass)
+RETURNS void
+LANGUAGE sql STRICT AS $$
+  DELETE FROM logicalrep.publication_rel WHERE pubname = $1 AND relid = $2
+$$;
+
+-- The tables a subscriber to the given publications receives
+CREATE FUNCTION publication_tables(publications text[])
+RETURNS TABLE (nspname name, relname name)
+LANGUAGE sql STABLE STRICT AS $$
+  SELECT n.nspname, c.relname
+  FROM pg_catalog.pg_class c
+       JOIN pg_catalog.pg_namespace n ON n.oid = c.relnamespace
+  WHERE c.relkind = 'r' AND c.relpersistence = 'p' AND c.oid >= 16384
+    AND n.nspname <> 'logicalrep'
+    AND (c.oid IN (SELECT r.relid FROM logicalrep.publication_rel r
+                   WHERE r.pubname::text = ANY ($1))
+         OR EXISTS (SELECT 1 FROM logicalrep.publication p
+                    WHERE p.all_tables AND p.pubname::text = ANY ($1)))
+  ORDER BY 1, 2
+$$;
+
+--
+-- Subscriber side
+--
+CREATE TABLE subscription (
+    subid serial PRIMARY KEY,
+    subname name NOT NULL UNIQUE,
+    conninfo text NOT NULL,
+    slot_name name NOT NULL,
+    publications text[] NOT NULL,
+    enabled boolean NOT NULL,
+    copy_data boolean NOT NULL,
+    synced boolean NOT NULL DEFAULT false,
+    apply_workers integer NOT NULL,
+    sync_workers integer NOT NULL
+);
+
+CREATE FUNCTION create_subscription(subname name,
+                                    conninfo text,
+                                    publications text[],
+                                    slot_name name DEFAULT NULL,
+                                    copy_data boolean DEFAULT true,
+                                    apply_workers integer DEFAULT 4,
+                                    sync_workers integer DEFAULT 2,
+                                    enabled boolean DEFAULT true)
+RETURNS integer
+AS 'MODULE_PATHNAME', 'logicalrep_create_subscription'
+LANGUAGE C;
+
+CREATE FUNCTION drop_subscription(subname name,
+                                  drop_slot boolean DEFAULT true)
+RETURNS void
+AS 'MODULE_PATHNAME', 'logicalrep_drop_subscription'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION enable_subscription(subname name,
+                                    enabled boolean DEFAULT true)
+RETURNS void
+AS 'MODULE_PATHNAME', 'logicalrep_enable_subscription'
+LANGUAGE C STRICT;
+
+-- Subscriptions hold connection strings, which may include passwords
+REVOKE ALL ON subscription FROM PUBLIC;
+REVOKE ALL ON FUNCTION create_subscription(name, text, text[], name, boolean,
+                                           integer, integer, boolean) FROM PUBLIC;
+REVOKE ALL ON FUNCTION drop_subscription(name, boolean) FROM PUBLIC;
+REVOKE ALL ON FUNCTION enable_subscription(name, boolean) FROM PUBLIC;
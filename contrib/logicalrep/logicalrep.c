@@ -0,0 +1,1133 @@
+/*-------------------------------------------------------------------------
+ *
+ * logicalrep.c
+ *		  logical replication between PostgreSQL databases
+ *
+ * This file holds the module's setup, its SQL-callable functions and the
+ * processes that start subscriptions.  At server start a supervisor
+ * launches a manager in every database that accepts connections.  A
+ * manager exits at once if the extension isn't installed in its database;
+ * otherwise it starts, and restarts after a failure, a leader for each
+ * enabled subscription.  The leader and its apply and sync workers are in
+ * logicalrep_apply.c and logicalrep_sync.c.
+ *
+ * Managers and leaders are registered in a small array in shared memory,
+ * so that SQL functions can wake a manager or stop a leader.
+ *
+ * Copyright (c) 2015, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		  contrib/logicalrep/logicalrep.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <signal.h>
+#include <unistd.h>
+
+#include "logicalrep.h"
+
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "access/transam.h"
+#include "access/xact.h"
+#include "catalog/namespace.h"
+#include "catalog/pg_database.h"
+#include "catalog/pg_type.h"
+#include "commands/trigger.h"
+#include "executor/spi.h"
+#include "funcapi.h"
+#include "mb/pg_wchar.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "postmaster/bgworker.h"
+#include "postmaster/postmaster.h"
+#include "replication/origin.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/lmgr.h"
+#include "storage/lwlock.h"
+#include "storage/proc.h"
+#include "storage/procarray.h"
+#include "storage/shmem.h"
+#include "tcop/tcopprot.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/inval.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+
+PG_MODULE_MAGIC;
+
+void		_PG_init(void);
+
+PG_FUNCTION_INFO_V1(logicalrep_publication_add_table);
+PG_FUNCTION_INFO_V1(logicalrep_publication_changed);
+PG_FUNCTION_INFO_V1(logicalrep_create_subscription);
+PG_FUNCTION_INFO_V1(logicalrep_drop_subscription);
+PG_FUNCTION_INFO_V1(logicalrep_enable_subscription);
+
+/* A registered manager or leader */
+typedef struct LogicalRepWorkerSlot
+{
+	bool		in_use;
+	bool		is_manager;
+	Oid			dbid;
+	int			subid;			/* leaders only */
+	pid_t		pid;			/* 0 until the process has started */
+} LogicalRepWorkerSlot;
+
+typedef struct LogicalRepCtlData
+{
+	LWLock	   *lock;			/* protects the slots */
+	int			nslots;
+	LogicalRepWorkerSlot slots[FLEXIBLE_ARRAY_MEMBER];
+} LogicalRepCtlData;
+
+/* GUC variables */
+int			logicalrep_max_subscriptions = 16;
+int			logicalrep_copy_parallel_workers = 0;
+
+static LogicalRepCtlData *LogicalRepCtl = NULL;
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+/* Workers started by this process, stopped when it exits */
+static List *child_handles = NIL;
+
+/* What to do when the current transaction commits */
+static bool on_commit_wakeup_manager = false;
+static List *on_commit_stop_subids = NIL;
+
+static Size logicalrep_shmem_size(void);
+static void logicalrep_shmem_startup(void);
+static void logicalrep_xact_callback(XactEvent event, void *arg);
+static int	logicalrep_find_slot(bool is_manager, Oid dbid, int subid);
+static void logicalrep_detach(int code, Datum arg);
+static void logicalrep_launch_manager(Oid dbid);
+static void logicalrep_wakeup_manager(Oid dbid);
+static void logicalrep_launch_leader(int subid);
+static bool logicalrep_start_leaders(void);
+static void logicalrep_stop_leader(Oid dbid, int subid);
+static void logicalrep_check_preloaded(void);
+static void logicalrep_stop_children(int code, Datum arg);
+
+/*
+ * Module load callback
+ */
+void
+_PG_init(void)
+{
+	BackgroundWorker worker;
+
+	DefineCustomIntVariable("logicalrep.max_subscriptions",
+			"Sets the maximum number of subscriptions running at once.",
+							NULL,
+							&logicalrep_max_subscriptions,
+							16,
+							1,
+							MAX_BACKENDS,
+							PGC_POSTMASTER,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("logicalrep.copy_parallel_workers",
+							"Sets the number of parallel COPY workers loading each table during initial synchronization.",
+							NULL,
+							&logicalrep_copy_parallel_workers,
+							0,
+							0,
+							MAX_BACKENDS,
+							PGC_SIGHUP,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	EmitWarningsOnPlaceholders("logicalrep");
+
+	RegisterXactCallback(logicalrep_xact_callback, NULL);
+
+	/*
+	 * The output plugin needs nothing else, but subscriptions can only be
+	 * run if we are loaded at server start.
+	 */
+	if (!process_shared_preload_libraries_in_progress)
+		return;
+
+	RequestAddinShmemSpace(logicalrep_shmem_size());
+	RequestAddinLWLocks(1);
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = logicalrep_shmem_startup;
+
+	memset(&worker, 0, sizeof(worker));
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS |
+		BGWORKER_BACKEND_DATABASE_CONNECTION;
+	worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
+	worker.bgw_restart_time = BGW_NEVER_RESTART;
+	worker.bgw_main = NULL;
+	snprintf(worker.bgw_library_name, BGW_MAXLEN, "logicalrep");
+	snprintf(worker.bgw_function_name, BGW_MAXLEN,
+			 "logicalrep_supervisor_main");
+	snprintf(worker.bgw_name, BGW_MAXLEN, "logicalrep supervisor");
+	worker.bgw_main_arg = (Datum) 0;
+	worker.bgw_notify_pid = 0;
+	RegisterBackgroundWorker(&worker);
+}
+
+/*
+ * Every manager and leader takes a slot.  There is at most one manager per
+ * database with subscriptions, so twice the number of subscriptions is
+ * plenty.
+ */
+static Size
+logicalrep_shmem_size(void)
+{
+	return add_size(offsetof(LogicalRepCtlData, slots),
+					mul_size(2 * logicalrep_max_subscriptions,
+							 sizeof(LogicalRepWorkerSlot)));
+}
+
+static void
+logicalrep_shmem_startup(void)
+{
+	bool		found;
+
+	if (prev_shmem_startup_hook)
+		prev_shmem_startup_hook();
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	LogicalRepCtl = ShmemInitStruct("logicalrep", logicalrep_shmem_size(),
+									&found);
+	if (!found)
+	{
+		memset(LogicalRepCtl, 0, logicalrep_shmem_size());
+		LogicalRepCtl->lock = LWLockAssign();
+		LogicalRepCtl->nslots = 2 * logicalrep_max_subscriptions;
+	}
+
+	LWLockRelease(AddinShmemInitLock);
+}
+
+static void
+logicalrep_check_preloaded(void)
+{
+	if (LogicalRepCtl == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("logicalrep must be loaded via shared_preload_libraries")));
+}
+
+/*
+ * Find the slot of a manager or leader.  Caller must hold the lock.
+ */
+static int
+logicalrep_find_slot(bool is_manager, Oid dbid, int subid)
+{
+	int			i;
+
+	for (i = 0; i < LogicalRepCtl->nslots; i++)
+	{
+		LogicalRepWorkerSlot *slot = &LogicalRepCtl->slots[i];
+
+		if (slot->in_use && slot->is_manager == is_manager &&
+			slot->dbid == dbid && (is_manager || slot->subid == subid))
+			return i;
+	}
+
+	return -1;
+}
+
+/*
+ * Give up our slot when we exit.
+ */
+static void
+logicalrep_detach(int code, Datum arg)
+{
+	LogicalRepWorkerSlot *slot = &LogicalRepCtl->slots[DatumGetInt32(arg)];
+
+	LWLockAcquire(LogicalRepCtl->lock, LW_EXCLUSIVE);
+	if (slot->pid == MyProcPid)
+	{
+		slot->in_use = false;
+		slot->pid = 0;
+	}
+	LWLockRelease(LogicalRepCtl->lock);
+}
+
+/*
+ * Called by a leader at startup: take over the slot its manager set up and
+ * learn which subscription to run.
+ */
+void
+logicalrep_leader_attach(int slotno, Oid *dbid, int *subid)
+{
+	LogicalRepWorkerSlot *slot = &LogicalRepCtl->slots[slotno];
+
+	LWLockAcquire(LogicalRepCtl->lock, LW_EXCLUSIVE);
+	if (!slot->in_use || slot->is_manager || slot->pid != 0)
+	{
+		/* our manager gave up on us */
+		LWLockRelease(LogicalRepCtl->lock);
+		proc_exit(0);
+	}
+	slot->pid = MyProcPid;
+	*dbid = slot->dbid;
+	*subid = slot->subid;
+	LWLockRelease(LogicalRepCtl->lock);
+
+	on_shmem_exit(logicalrep_detach, Int32GetDatum(slotno));
+}
+
+/*
+ * Lock a subscription.  A leader holds the lock for as long as it runs, so
+ * that dropping the subscription can wait for it to be gone.
+ */
+void
+logicalrep_lock_subscription(int subid, bool session)
+{
+	Oid			nspid = get_namespace_oid(LOGICALREP_SCHEMA, false);
+	Oid			classid = get_relname_relid("subscription", nspid);
+	LOCKTAG		tag;
+
+	SET_LOCKTAG_OBJECT(tag, MyDatabaseId, classid, subid, 0);
+	(void) LockAcquire(&tag, AccessExclusiveLock, session, false);
+}
+
+/*
+ * Name of the replication origin tracking the progress of an apply worker.
+ */
+char *
+logicalrep_origin_name(int subid, int workerno)
+{
+	return psprintf("logicalrep_%d_%d", subid, workerno);
+}
+
+/*
+ * Launch a manager for a database.  If one is running already, the new one
+ * will notice and exit.
+ */
+static void
+logicalrep_launch_manager(Oid dbid)
+{
+	BackgroundWorker worker;
+
+	memset(&worker, 0, sizeof(worker));
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS |
+		BGWORKER_BACKEND_DATABASE_CONNECTION;
+	worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
+	worker.bgw_restart_time = LOGICALREP_RESTART_INTERVAL;
+	worker.bgw_main = NULL;
+	snprintf(worker.bgw_library_name, BGW_MAXLEN, "logicalrep");
+	snprintf(worker.bgw_function_name, BGW_MAXLEN,
+			 "logicalrep_manager_main");
+	snprintf(worker.bgw_name, BGW_MAXLEN, "logicalrep manager %u", dbid);
+	worker.bgw_main_arg = ObjectIdGetDatum(dbid);
+	worker.bgw_notify_pid = 0;
+
+	if (!RegisterDynamicBackgroundWorker(&worker, NULL))
+		ereport(WARNING,
+				(errcode(ERRCODE_CONFIGURATION_LIMIT_EXCEEDED),
+				 errmsg("out of background worker slots"),
+				 errhint("You might need to increase max_worker_processes.")));
+}
+
+/*
+ * Make the manager of a database look at the subscriptions again, starting
+ * it if it isn't running.
+ */
+static void
+logicalrep_wakeup_manager(Oid dbid)
+{
+	int			slotno;
+	pid_t		pid = 0;
+
+	LWLockAcquire(LogicalRepCtl->lock, LW_SHARED);
+	slotno = logicalrep_find_slot(true, dbid, 0);
+	if (slotno >= 0)
+		pid = LogicalRepCtl->slots[slotno].pid;
+	LWLockRelease(LogicalRepCtl->lock);
+
+	if (slotno < 0)
+		logicalrep_launch_manager(dbid);
+	else if (pid != 0)
+	{
+		PGPROC	   *proc = BackendPidGetProc(pid);
+
+		if (proc != NULL)
+			SetLatch(&proc->procLatch);
+	}
+}
+
+/*
+ * Tell the leader of a subscription to exit.  Its manager won't start it
+ * again once the subscription is gone or disabled.
+ */
+static void
+logicalrep_stop_leader(Oid dbid, int subid)
+{
+	int			slotno;
+	pid_t		pid = 0;
+
+	LWLockAcquire(LogicalRepCtl->lock, LW_SHARED);
+	slotno = logicalrep_find_slot(false, dbid, subid);
+	if (slotno >= 0)
+		pid = LogicalRepCtl->slots[slotno].pid;
+	LWLockRelease(LogicalRepCtl->lock);
+
+	if (pid != 0)
+		kill(pid, SIGTERM);
+}
+
+/*
+ * Start and stop subscriptions only once the change that asked for it has
+ * committed; otherwise the leader might not see it.
+ */
+static void
+logicalrep_xact_callback(XactEvent event, void *arg)
+{
+	ListCell   *lc;
+
+	switch (event)
+	{
+		case XACT_EVENT_COMMIT:
+			if (on_commit_wakeup_manager)
+				logicalrep_wakeup_manager(MyDatabaseId);
+			foreach(lc, on_commit_stop_subids)
+				logicalrep_stop_leader(MyDatabaseId, lfirst_int(lc));
+			/* FALLTHROUGH */
+		case XACT_EVENT_ABORT:
+			on_commit_wakeup_manager = false;
+			list_free(on_commit_stop_subids);
+			on_commit_stop_subids = NIL;
+			break;
+		default:
+			break;
+	}
+}
+
+/*
+ * Main entry point of the supervisor.
+ *
+ * All it does is start a manager in each database.  Any database would do
+ * to read pg_database from; template1 is the one that is always there.  We
+ * leave it again right away, so as not to get in the way of CREATE
+ * DATABASE.
+ */
+void
+logicalrep_supervisor_main(Datum main_arg)
+{
+	Relation	rel;
+	HeapScanDesc scan;
+	HeapTuple	tup;
+
+	pqsignal(SIGTERM, die);
+	BackgroundWorkerUnblockSignals();
+
+	BackgroundWorkerInitializeConnection("template1", NULL);
+
+	StartTransactionCommand();
+
+	rel = heap_open(DatabaseRelationId, AccessShareLock);
+	scan = heap_beginscan_catalog(rel, 0, NULL);
+	while (HeapTupleIsValid(tup = heap_getnext(scan, ForwardScanDirection)))
+	{
+		Form_pg_database pgdatabase = (Form_pg_database) GETSTRUCT(tup);
+
+		if (pgdatabase->datallowconn)
+			logicalrep_launch_manager(HeapTupleGetOid(tup));
+	}
+	heap_endscan(scan);
+	heap_close(rel, AccessShareLock);
+
+	CommitTransactionCommand();
+
+	proc_exit(0);
+}
+
+/*
+ * Main entry point of the manager of one database.
+ */
+void
+logicalrep_manager_main(Datum main_arg)
+{
+	Oid			dbid = DatumGetObjectId(main_arg);
+	int			slotno;
+	LogicalRepWorkerSlot *slot;
+
+	pqsignal(SIGTERM, die);
+	BackgroundWorkerUnblockSignals();
+
+	LWLockAcquire(LogicalRepCtl->lock, LW_EXCLUSIVE);
+	if (logicalrep_find_slot(true, dbid, 0) >= 0)
+	{
+		/* someone beat us to it */
+		LWLockRelease(LogicalRepCtl->lock);
+		proc_exit(0);
+	}
+	for (slotno = 0; slotno < LogicalRepCtl->nslots; slotno++)
+	{
+		if (!LogicalRepCtl->slots[slotno].in_use)
+			break;
+	}
+	if (slotno >= LogicalRepCtl->nslots)
+	{
+		LWLockRelease(LogicalRepCtl->lock);
+		ereport(LOG,
+				(errmsg("no free slot for logicalrep manager of database %u",
+						dbid),
+		errhint("You might need to increase logicalrep.max_subscriptions.")));
+		proc_exit(0);
+	}
+	slot = &LogicalRepCtl->slots[slotno];
+	slot->in_use = true;
+	slot->is_manager = true;
+	slot->dbid = dbid;
+	slot->subid = 0;
+	slot->pid = MyProcPid;
+	LWLockRelease(LogicalRepCtl->lock);
+
+	on_shmem_exit(logicalrep_detach, Int32GetDatum(slotno));
+
+	BackgroundWorkerInitializeConnectionByOid(dbid, InvalidOid);
+
+	while (logicalrep_start_leaders())
+	{
+		int			rc;
+
+		rc = WaitLatch(MyLatch,
+					   WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+					   LOGICALREP_RESTART_INTERVAL * 1000L);
+		ResetLatch(MyLatch);
+
+		if (rc & WL_POSTMASTER_DEATH)
+			proc_exit(1);
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	/* the extension isn't installed here; nothing for us to do */
+	proc_exit(0);
+}
+
+/*
+ * Start a leader for every enabled subscription that doesn't have one.
+ * Returns false if the extension isn't installed.
+ */
+static bool
+logicalrep_start_leaders(void)
+{
+	List	   *subids = NIL;
+	ListCell   *lc;
+	bool		installed;
+	MemoryContext oldcxt = CurrentMemoryContext;
+
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+	SPI_connect();
+	PushActiveSnapshot(GetTransactionSnapshot());
+	pgstat_report_activity(STATE_RUNNING, "starting subscriptions");
+
+	installed = OidIsValid(get_namespace_oid(LOGICALREP_SCHEMA, true));
+	if (installed)
+	{
+		uint32		i;
+
+		if (SPI_execute("SELECT subid FROM logicalrep.subscription WHERE enabled",
+						true, 0) != SPI_OK_SELECT)
+			elog(ERROR, "could not read subscriptions");
+
+		for (i = 0; i < SPI_processed; i++)
+		{
+			bool		isnull;
+			Datum		subid;
+			MemoryContext spicxt;
+
+			subid = SPI_getbinval(SPI_tuptable->vals[i],
+								  SPI_tuptable->tupdesc, 1, &isnull);
+			spicxt = MemoryContextSwitchTo(oldcxt);
+			subids = lappend_int(subids, DatumGetInt32(subid));
+			MemoryContextSwitchTo(spicxt);
+		}
+	}
+
+	SPI_finish();
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+	pgstat_report_activity(STATE_IDLE, NULL);
+
+	foreach(lc, subids)
+		logicalrep_launch_leader(lfirst_int(lc));
+	list_free(subids);
+
+	return installed;
+}
+
+/*
+ * Start the leader of a subscription, unless it's running.
+ */
+static void
+logicalrep_launch_leader(int subid)
+{
+	BackgroundWorker worker;
+	BackgroundWorkerHandle *handle;
+	LogicalRepWorkerSlot *slot;
+	int			slotno;
+	pid_t		pid;
+
+	LWLockAcquire(LogicalRepCtl->lock, LW_EXCLUSIVE);
+	if (logicalrep_find_slot(false, MyDatabaseId, subid) >= 0)
+	{
+		LWLockRelease(LogicalRepCtl->lock);
+		return;
+	}
+	for (slotno = 0; slotno < LogicalRepCtl->nslots; slotno++)
+	{
+		if (!LogicalRepCtl->slots[slotno].in_use)
+			break;
+	}
+	if (slotno >= LogicalRepCtl->nslots)
+	{
+		LWLockRelease(LogicalRepCtl->lock);
+		ereport(WARNING,
+				(errmsg("no free slot for subscription %d", subid),
+		errhint("You might need to increase logicalrep.max_subscriptions.")));
+		return;
+	}
+	slot = &LogicalRepCtl->slots[slotno];
+	slot->in_use = true;
+	slot->is_manager = false;
+	slot->dbid = MyDatabaseId;
+	slot->subid = subid;
+	slot->pid = 0;
+	LWLockRelease(LogicalRepCtl->lock);
+
+	memset(&worker, 0, sizeof(worker));
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS |
+		BGWORKER_BACKEND_DATABASE_CONNECTION;
+	worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
+	worker.bgw_restart_time = BGW_NEVER_RESTART;
+	worker.bgw_main = NULL;
+	snprintf(worker.bgw_library_name, BGW_MAXLEN, "logicalrep");
+	snprintf(worker.bgw_function_name, BGW_MAXLEN, "logicalrep_leader_main");
+	snprintf(worker.bgw_name, BGW_MAXLEN, "logicalrep leader %d", subid);
+	worker.bgw_main_arg = Int32GetDatum(slotno);
+	worker.bgw_notify_pid = MyProcPid;
+
+	if (!RegisterDynamicBackgroundWorker(&worker, &handle))
+	{
+		LWLockAcquire(LogicalRepCtl->lock, LW_EXCLUSIVE);
+		slot->in_use = false;
+		LWLockRelease(LogicalRepCtl->lock);
+		ereport(WARNING,
+				(errcode(ERRCODE_CONFIGURATION_LIMIT_EXCEEDED),
+				 errmsg("out of background worker slots"),
+				 errhint("You might need to increase max_worker_processes.")));
+		return;
+	}
+
+	/*
+	 * If the leader never got as far as taking over its slot, release the
+	 * slot for it.  Only we start leaders for this database, so a slot that
+	 * still names the subscription and has no process is ours.
+	 */
+	if (WaitForBackgroundWorkerStartup(handle, &pid) != BGWH_STARTED)
+	{
+		LWLockAcquire(LogicalRepCtl->lock, LW_EXCLUSIVE);
+		if (slot->in_use && !slot->is_manager && slot->pid == 0 &&
+			slot->dbid == MyDatabaseId && slot->subid == subid)
+			slot->in_use = false;
+		LWLockRelease(LogicalRepCtl->lock);
+	}
+	pfree(handle);
+}
+
+/*
+ * Start an apply or sync worker for the leader.  We get told when it starts
+ * and stops, and it's terminated when we exit, however that happens.
+ */
+BackgroundWorkerHandle *
+logicalrep_start_child(const char *name, const char *function,
+					   Datum main_arg)
+{
+	BackgroundWorker worker;
+	BackgroundWorkerHandle *handle;
+	MemoryContext oldcxt;
+
+	memset(&worker, 0, sizeof(worker));
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS |
+		BGWORKER_BACKEND_DATABASE_CONNECTION;
+	worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
+	worker.bgw_restart_time = BGW_NEVER_RESTART;
+	worker.bgw_main = NULL;
+	snprintf(worker.bgw_library_name, BGW_MAXLEN, "logicalrep");
+	snprintf(worker.bgw_function_name, BGW_MAXLEN, "%s", function);
+	snprintf(worker.bgw_name, BGW_MAXLEN, "%s", name);
+	worker.bgw_main_arg = main_arg;
+	worker.bgw_notify_pid = MyProcPid;
+
+	oldcxt = MemoryContextSwitchTo(TopMemoryContext);
+	if (!RegisterDynamicBackgroundWorker(&worker, &handle))
+		ereport(ERROR,
+				(errcode(ERRCODE_CONFIGURATION_LIMIT_EXCEEDED),
+				 errmsg("out of background worker slots"),
+				 errhint("You might need to increase max_worker_processes.")));
+	if (child_handles == NIL)
+		before_shmem_exit(logicalrep_stop_children, (Datum) 0);
+	child_handles = lappend(child_handles, handle);
+	MemoryContextSwitchTo(oldcxt);
+
+	return handle;
+}
+
+/*
+ * Terminate our workers, and wait until they're gone, so that whoever
+ * waits for us to exit knows they have released their origins and locks.
+ */
+static void
+logicalrep_stop_children(int code, Datum arg)
+{
+	ListCell   *lc;
+
+	foreach(lc, child_handles)
+		TerminateBackgroundWorker((BackgroundWorkerHandle *) lfirst(lc));
+
+	foreach(lc, child_handles)
+	{
+		BackgroundWorkerHandle *handle = lfirst(lc);
+		pid_t		pid;
+		BgwHandleStatus status;
+
+		for (;;)
+		{
+			status = GetBackgroundWorkerPid(handle, &pid);
+			if (status != BGWH_STARTED && status != BGWH_NOT_YET_STARTED)
+				break;
+			pg_usleep(10000L);
+		}
+	}
+}
+
+/*
+ * Connect to the publisher.  Values are exchanged in our database
+ * encoding, so that no conversion is needed on this side.
+ */
+PGconn *
+logicalrep_connect(const char *conninfo, bool replication,
+				   const char *appname)
+{
+	const char *keys[5];
+	const char *vals[5];
+	int			i = 0;
+	PGconn	   *conn;
+
+	keys[i] = "dbname";
+	vals[i++] = conninfo;
+	if (replication)
+	{
+		keys[i] = "replication";
+		vals[i++] = "database";
+	}
+	keys[i] = "fallback_application_name";
+	vals[i++] = appname;
+	keys[i] = "client_encoding";
+	vals[i++] = GetDatabaseEncodingName();
+	keys[i] = NULL;
+	vals[i] = NULL;
+
+	conn = PQconnectdbParams(keys, vals, /* expand_dbname = */ true);
+	if (PQstatus(conn) != CONNECTION_OK)
+	{
+		char	   *msg = pstrdup(PQerrorMessage(conn));
+
+		PQfinish(conn);
+		ereport(ERROR,
+				(errcode(ERRCODE_SQLCLIENT_UNABLE_TO_ESTABLISH_SQLCONNECTION),
+				 errmsg("could not connect to the publisher: %s", msg)));
+	}
+
+	return conn;
+}
+
+/*
+ * Run a query on the publisher, waiting on our latch so that we can still
+ * be interrupted.  Replication connections only understand the simple
+ * query protocol, so queries without parameters are sent that way.
+ *
+ * Like PQexec(), returns the last result, or the first one of COPY.
+ */
+PGresult *
+logicalrep_exec(PGconn *conn, const char *query, int nparams,
+				const char *const * params)
+{
+	PGresult   *result = NULL;
+	PGresult   *lastResult = NULL;
+	int			sent;
+
+	if (nparams == 0)
+		sent = PQsendQuery(conn, query);
+	else
+		sent = PQsendQueryParams(conn, query, nparams, NULL, params,
+								 NULL, NULL, 0);
+	if (!sent)
+		ereport(ERROR,
+				(errcode(ERRCODE_CONNECTION_FAILURE),
+				 errmsg("could not send query to the publisher: %s",
+						PQerrorMessage(conn))));
+
+	for (;;)
+	{
+		while (PQisBusy(conn))
+		{
+			int			rc;
+
+			rc = WaitLatchOrSocket(MyLatch,
+								   WL_LATCH_SET | WL_SOCKET_READABLE |
+								   WL_POSTMASTER_DEATH,
+								   PQsocket(conn), 0);
+			ResetLatch(MyLatch);
+
+			if (rc & WL_POSTMASTER_DEATH)
+				proc_exit(1);
+
+			CHECK_FOR_INTERRUPTS();
+
+			if (PQconsumeInput(conn) == 0)
+				ereport(ERROR,
+						(errcode(ERRCODE_CONNECTION_FAILURE),
+						 errmsg("could not receive data from the publisher: %s",
+								PQerrorMessage(conn))));
+		}
+
+		result = PQgetResult(conn);
+		if (result == NULL)
+			break;
+
+		PQclear(lastResult);
+		lastResult = result;
+
+		if (PQresultStatus(lastResult) == PGRES_COPY_IN ||
+			PQresultStatus(lastResult) == PGRES_COPY_OUT ||
+			PQresultStatus(lastResult) == PGRES_COPY_BOTH ||
+			PQstatus(conn) == CONNECTION_BAD)
+			break;
+	}
+
+	return lastResult;
+}
+
+/*
+ * publication_add_table(pubname name, relation regclass)
+ */
+Datum
+logicalrep_publication_add_table(PG_FUNCTION_ARGS)
+{
+	Datum		values[2];
+	Oid			argtypes[2] = {NAMEOID, OIDOID};
+	Oid			relid = PG_GETARG_OID(1);
+	Relation	rel;
+
+	rel = relation_open(relid, AccessShareLock);
+	if (rel->rd_rel->relkind != RELKIND_RELATION)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("\"%s\" is not a table",
+						RelationGetRelationName(rel))));
+	if (rel->rd_rel->relpersistence != RELPERSISTENCE_PERMANENT)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("table \"%s\" cannot be published",
+						RelationGetRelationName(rel)),
+				 errdetail("Temporary and unlogged tables are not decoded.")));
+	if (relid < FirstNormalObjectId ||
+		RelationGetNamespace(rel) == get_namespace_oid(LOGICALREP_SCHEMA,
+													   false))
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("table \"%s\" cannot be published",
+						RelationGetRelationName(rel)),
+				 errdetail("System tables are never published.")));
+	relation_close(rel, AccessShareLock);
+
+	values[0] = PG_GETARG_DATUM(0);
+	values[1] = ObjectIdGetDatum(relid);
+
+	SPI_connect();
+	if (SPI_execute_with_args("INSERT INTO logicalrep.publication_rel VALUES ($1, $2)",
+							  2, argtypes, values, NULL,
+							  false, 0) != SPI_OK_INSERT)
+		elog(ERROR, "could not add table to publication");
+	SPI_finish();
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * Statement trigger on the publication tables.  The relcache invalidation
+ * of the table reaches the output plugins decoding this transaction's
+ * commit, which then reload the publications.
+ */
+Datum
+logicalrep_publication_changed(PG_FUNCTION_ARGS)
+{
+	TriggerData *trigdata = (TriggerData *) fcinfo->context;
+
+	if (!CALLED_AS_TRIGGER(fcinfo))
+		elog(ERROR, "logicalrep_publication_changed: not called by trigger manager");
+
+	CacheInvalidateRelcacheByRelid(RelationGetRelid(trigdata->tg_relation));
+
+	return PointerGetDatum(NULL);
+}
+
+/*
+ * create_subscription(subname name, conninfo text, publications text[],
+ *					   slot_name name, copy_data boolean,
+ *					   apply_workers integer, sync_workers integer,
+ *					   enabled boolean)
+ *
+ * Returns the new subscription's ID.
+ */
+Datum
+logicalrep_create_subscription(PG_FUNCTION_ARGS)
+{
+	Name		subname;
+	char	   *conninfo;
+	ArrayType  *publications;
+	bool		copy_data;
+	int			apply_workers;
+	int			sync_workers;
+	bool		enabled;
+	Datum		values[8];
+	Oid			argtypes[8] = {NAMEOID, TEXTOID, NAMEOID, TEXTARRAYOID,
+	BOOLOID, BOOLOID, INT4OID, INT4OID};
+	PQconninfoOption *opts;
+	char	   *err = NULL;
+	bool		isnull;
+	int			subid;
+	int			i;
+
+	logicalrep_check_preloaded();
+
+	/* only the slot name may be NULL */
+	for (i = 0; i < PG_NARGS(); i++)
+	{
+		if (i != 3 && PG_ARGISNULL(i))
+			ereport(ERROR,
+					(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+					 errmsg("argument %d of create_subscription must not be null",
+							i + 1)));
+	}
+	subname = PG_GETARG_NAME(0);
+	conninfo = text_to_cstring(PG_GETARG_TEXT_PP(1));
+	publications = PG_GETARG_ARRAYTYPE_P(2);
+	copy_data = PG_GETARG_BOOL(4);
+	apply_workers = PG_GETARG_INT32(5);
+	sync_workers = PG_GETARG_INT32(6);
+	enabled = PG_GETARG_BOOL(7);
+
+	opts = PQconninfoParse(conninfo, &err);
+	if (opts == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_SYNTAX_ERROR),
+				 errmsg("invalid connection string syntax: %s", err)));
+	PQconninfoFree(opts);
+
+	if (ARR_NDIM(publications) != 1 ||
+		ArrayGetNItems(ARR_NDIM(publications), ARR_DIMS(publications)) < 1 ||
+		array_contains_nulls(publications))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("publications must be a non-empty array without nulls")));
+
+	if (apply_workers < 1 || apply_workers > LOGICALREP_MAX_APPLY_WORKERS)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("apply_workers must be between 1 and %d",
+						LOGICALREP_MAX_APPLY_WORKERS)));
+	if (sync_workers < 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("sync_workers must be at least 1")));
+
+	values[0] = NameGetDatum(subname);
+	values[1] = CStringGetTextDatum(conninfo);
+	values[2] = PG_ARGISNULL(3) ? NameGetDatum(subname) : PG_GETARG_DATUM(3);
+	values[3] = PointerGetDatum(publications);
+	values[4] = BoolGetDatum(enabled);
+	values[5] = BoolGetDatum(copy_data);
+	values[6] = Int32GetDatum(apply_workers);
+	values[7] = Int32GetDatum(sync_workers);
+
+	SPI_connect();
+	if (SPI_execute_with_args("INSERT INTO logicalrep.subscription "
+							  "(subname, conninfo, slot_name, publications, enabled, "
+							  "copy_data, apply_workers, sync_workers) "
+							  "VALUES ($1, $2, $3, $4, $5, $6, $7, $8) "
+							  "RETURNING subid",
+							  8, argtypes, values, NULL,
+							  false, 1) != SPI_OK_INSERT_RETURNING)
+		elog(ERROR, "could not create subscription");
+	subid = DatumGetInt32(SPI_getbinval(SPI_tuptable->vals[0],
+										SPI_tuptable->tupdesc, 1, &isnull));
+	SPI_finish();
+
+	/* each apply worker tracks the transactions it applied */
+	for (i = 0; i < apply_workers; i++)
+		replorigin_create(logicalrep_origin_name(subid, i));
+
+	if (enabled)
+		on_commit_wakeup_manager = true;
+
+	PG_RETURN_INT32(subid);
+}
+
+/*
+ * drop_subscription(subname name, drop_slot boolean)
+ *
+ * The replication origins and the slot on the publisher are not
+ * transactional, so this can't run in a transaction block.
+ */
+Datum
+logicalrep_drop_subscription(PG_FUNCTION_ARGS)
+{
+	Name		subname = PG_GETARG_NAME(0);
+	bool		drop_slot = PG_GETARG_BOOL(1);
+	Datum		values[1];
+	Oid			argtypes[1] = {NAMEOID};
+	bool		isnull;
+	int			subid;
+	int			apply_workers;
+	char	   *conninfo;
+	char	   *slot_name;
+	int			i;
+
+	logicalrep_check_preloaded();
+	PreventTransactionChain(true, "logicalrep.drop_subscription()");
+
+	values[0] = NameGetDatum(subname);
+
+	SPI_connect();
+	if (SPI_execute_with_args("DELETE FROM logicalrep.subscription "
+							  "WHERE subname = $1 "
+							  "RETURNING subid, apply_workers, conninfo, slot_name",
+							  1, argtypes, values, NULL,
+							  false, 0) != SPI_OK_DELETE_RETURNING)
+		elog(ERROR, "could not drop subscription");
+	if (SPI_processed == 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_UNDEFINED_OBJECT),
+				 errmsg("subscription \"%s\" does not exist",
+						NameStr(*subname))));
+	subid = DatumGetInt32(SPI_getbinval(SPI_tuptable->vals[0],
+										SPI_tuptable->tupdesc, 1, &isnull));
+	apply_workers = DatumGetInt32(SPI_getbinval(SPI_tuptable->vals[0],
+												SPI_tuptable->tupdesc, 2,
+												&isnull));
+	conninfo = SPI_getvalue(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 3);
+	slot_name = SPI_getvalue(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 4);
+
+	/*
+	 * Stop the leader and wait for it to release the subscription lock.  It
+	 * stops its workers first, so after that no one has the origins set up.
+	 * A leader starting meanwhile waits for us, and then finds the
+	 * subscription gone.
+	 */
+	logicalrep_stop_leader(MyDatabaseId, subid);
+	logicalrep_lock_subscription(subid, false);
+
+	for (i = 0; i < apply_workers; i++)
+	{
+		RepOriginId originid;
+
+		originid = replorigin_by_name(logicalrep_origin_name(subid, i), true);
+		if (originid != InvalidRepOriginId)
+			replorigin_drop(originid);
+	}
+
+	if (drop_slot)
+	{
+		PGconn	   *conn;
+		PGresult   *res;
+		char	   *cmd;
+
+		conn = logicalrep_connect(conninfo, true, "logicalrep");
+		PG_TRY();
+		{
+			cmd = psprintf("DROP_REPLICATION_SLOT %s",
+						   quote_identifier(slot_name));
+			res = logicalrep_exec(conn, cmd, 0, NULL);
+			if (PQresultStatus(res) != PGRES_COMMAND_OK)
+				ereport(ERROR,
+						(errcode(ERRCODE_CONNECTION_FAILURE),
+						 errmsg("could not drop replication slot \"%s\" on the publisher: %s",
+								slot_name, PQerrorMessage(conn)),
+						 errhint("Use drop_slot => false to drop the subscription without it.")));
+			PQclear(res);
+		}
+		PG_CATCH();
+		{
+			PQfinish(conn);
+			PG_RE_THROW();
+		}
+		PG_END_TRY();
+		PQfinish(conn);
+	}
+
+	SPI_finish();
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * enable_subscription(subname name, enabled boolean)
+ */
+Datum
+logicalrep_enable_subscription(PG_FUNCTION_ARGS)
+{
+	bool		enabled = PG_GETARG_BOOL(1);
+	Datum		values[2];
+	Oid			argtypes[2] = {NAMEOID, BOOLOID};
+	bool		isnull;
+	int			subid;
+	MemoryContext oldcxt;
+
+	logicalrep_check_preloaded();
+
+	values[0] = PG_GETARG_DATUM(0);
+	values[1] = BoolGetDatum(enabled);
+
+	SPI_connect();
+	if (SPI_execute_with_args("UPDATE logicalrep.subscription "
+							  "SET enabled = $2 WHERE subname = $1 "
+							  "RETURNING subid",
+							  2, argtypes, values, NULL,
+							  false, 0) != SPI_OK_UPDATE_RETURNING)
+		elog(ERROR, "could not update subscription");
+	if (SPI_processed == 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_UNDEFINED_OBJECT),
+				 errmsg("subscription \"%s\" does not exist",
+						NameStr(*PG_GETARG_NAME(0)))));
+	subid = DatumGetInt32(SPI_getbinval(SPI_tuptable->vals[0],
+										SPI_tuptable->tupdesc, 1, &isnull));
+	SPI_finish();
+
+	if (enabled)
+		on_commit_wakeup_manager = true;
+	else
+	{
+		oldcxt = MemoryContextSwitchTo(TopMemoryContext);
+		on_commit_stop_subids = lappend_int(on_commit_stop_subids, subid);
+		MemoryContextSwitchTo(oldcxt);
+	}
+
+	PG_RETURN_VOID();
+}
@@ -0,0 +1,128 @@
+/*-------------------------------------------------------------------------
+ *
+ * logicalrep.h
+ *		  Declarations shared by the parts of the logicalrep module
+ *
+ * Copyright (c) 2015, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		  contrib/logicalrep/logicalrep.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef LOGICALREP_H
+#define LOGICALREP_H
+
+#include "libpq-fe.h"
+
+#include "access/htup.h"
+#include "lib/stringinfo.h"
+#include "postmaster/bgworker.h"
+#include "replication/reorderbuffer.h"
+#include "utils/rel.h"
+
+/* The schema holding the module's tables and functions */
+#define LOGICALREP_SCHEMA			"logicalrep"
+
+/* Version of the protocol spoken between the output plugin and apply */
+#define LOGICALREP_PROTO_VERSION	1
+
+/* Upper limit for the number of apply workers of one subscription */
+#define LOGICALREP_MAX_APPLY_WORKERS	32
+
+/* Seconds to wait before restarting a failed subscription */
+#define LOGICALREP_RESTART_INTERVAL	5
+
+/* Flags of the attributes in a relation message */
+#define LOGICALREP_IS_KEY			0x01
+
+/* Column status bytes in a tuple message */
+#define LOGICALREP_COLUMN_NULL		'n'
+#define LOGICALREP_COLUMN_UNCHANGED	'u'
+#define LOGICALREP_COLUMN_TEXT		't'
+
+/* Transaction begin, as sent by the output plugin */
+typedef struct LogicalRepBeginData
+{
+	XLogRecPtr	final_lsn;
+	TimestampTz committime;
+	TransactionId xid;
+} LogicalRepBeginData;
+
+/* Transaction commit */
+typedef struct LogicalRepCommitData
+{
+	XLogRecPtr	commit_lsn;
+	XLogRecPtr	end_lsn;
+	TimestampTz committime;
+} LogicalRepCommitData;
+
+/* Description of a published relation */
+typedef struct LogicalRepRelation
+{
+	uint32		remoteid;		/* relation OID on the publisher */
+	char	   *nspname;
+	char	   *relname;
+	int			natts;
+	char	  **attnames;
+	bool	   *attkeys;		/* is the column part of the identity? */
+} LogicalRepRelation;
+
+/* One row, with each column in text form */
+typedef struct LogicalRepTupleData
+{
+	int			natts;
+	char	   *status;			/* LOGICALREP_COLUMN_* per column */
+	char	  **values;			/* NULL unless status is _TEXT */
+} LogicalRepTupleData;
+
+/* logicalrep_proto.c */
+extern void logicalrep_write_begin(StringInfo out, ReorderBufferTXN *txn);
+extern void logicalrep_write_commit(StringInfo out, ReorderBufferTXN *txn,
+						XLogRecPtr commit_lsn);
+extern void logicalrep_write_rel(StringInfo out, Relation rel);
+extern void logicalrep_write_insert(StringInfo out, Relation rel,
+						HeapTuple newtuple);
+extern void logicalrep_write_update(StringInfo out, Relation rel,
+						HeapTuple oldtuple, HeapTuple newtuple);
+extern void logicalrep_write_delete(StringInfo out, Relation rel,
+						HeapTuple oldtuple);
+
+extern void logicalrep_read_begin(StringInfo in, LogicalRepBeginData *begin);
+extern void logicalrep_read_commit(StringInfo in,
+					   LogicalRepCommitData *commit);
+extern LogicalRepRelation *logicalrep_read_rel(StringInfo in);
+extern uint32 logicalrep_read_insert(StringInfo in,
+					   LogicalRepTupleData *newtup);
+extern uint32 logicalrep_read_update(StringInfo in, bool *has_oldtuple,
+					   LogicalRepTupleData *oldtup,
+					   LogicalRepTupleData *newtup);
+extern uint32 logicalrep_read_delete(StringInfo in,
+					   LogicalRepTupleData *oldtup);
+
+/* logicalrep.c */
+extern int	logicalrep_max_subscriptions;
+extern int	logicalrep_copy_parallel_workers;
+
+extern void logicalrep_leader_attach(int slotno, Oid *dbid, int *subid);
+extern void logicalrep_lock_subscription(int subid, bool session);
+extern char *logicalrep_origin_name(int subid, int workerno);
+extern PGconn *logicalrep_connect(const char *conninfo, bool replication,
+				   const char *appname);
+extern PGresult *logicalrep_exec(PGconn *conn, const char *query,
+				int nparams, const char *const * params);
+extern BackgroundWorkerHandle *logicalrep_start_child(const char *name,
+					   const char *function, Datum main_arg);
+extern void logicalrep_supervisor_main(Datum main_arg) pg_attribute_noreturn();
+extern void logicalrep_manager_main(Datum main_arg) pg_attribute_noreturn();
+
+/* logicalrep_apply.c */
+extern void logicalrep_leader_main(Datum main_arg) pg_attribute_noreturn();
+extern void logicalrep_apply_main(Datum main_arg) pg_attribute_noreturn();
+
+/* logicalrep_sync.c */
+extern void logicalrep_sync_main(Datum main_arg) pg_attribute_noreturn();
+extern void logicalrep_sync_tables(const char *conninfo, const char *snapshot,
+					   const char *publications, int nworkers);
+
+#endif   /* LOGICALREP_H */
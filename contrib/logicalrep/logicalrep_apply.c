@@ -0,0 +1,1891 @@
+/*-------------------------------------------------------------------------
+ *
+ * logicalrep_apply.c
+ *		  apply changes received from the publisher
+ *
+ * Each subscription has a leader, which receives the changes of the
+ * publisher's transactions over a replication connection, and a fixed set
+ * of apply workers, which apply them.  The leader hands each transaction
+ * to an idle worker over a shared memory queue, so several transactions
+ * are applied at once.
+ *
+ * Transactions are numbered in the order they committed on the publisher,
+ * and the workers commit them in that same order: before committing, a
+ * worker waits until every earlier transaction has committed.  That keeps
+ * the subscriber's state a prefix of the publisher's history, and it means
+ * the position to restart from is simply the last transaction committed.
+ * Each worker reports its progress through a replication origin of its
+ * own, and the leader restarts from the furthest of them.
+ *
+ * Changes within the transactions can be applied out of order, unless they
+ * touch the same rows.  For each change the leader hashes the values of
+ * the replica identity and of the unique indexes of the target table, and
+ * remembers which transaction last used each key.  A change that uses a
+ * key of a transaction still in progress waits for it to commit before it's
+ * applied.  Tables with indexes whose keys can't be computed from the
+ * change, like expression or partial unique indexes and exclusion
+ * constraints, have their changes applied in commit order.  Keys are
+ * compared in the publisher's text form, so a dependency between values
+ * that are equal but print differently is missed; the row locks of the
+ * conflicting changes then order them, or a deadlock is detected and the
+ * subscription restarts.
+ *
+ * Changes are applied with SPI, with triggers and rules disabled the same
+ * way session_replication_role = replica does.
+ *
+ * Copyright (c) 2015, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		  contrib/logicalrep/logicalrep_apply.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "logicalrep.h"
+
+#include "access/genam.h"
+#include "access/hash.h"
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "access/xact.h"
+#include "catalog/namespace.h"
+#include "catalog/pg_index.h"
+#include "catalog/pg_replication_origin.h"
+#include "catalog/pg_type.h"
+#include "executor/spi.h"
+#include "libpq/pqformat.h"
+#include "miscadmin.h"
+#include "nodes/makefuncs.h"
+#include "pgstat.h"
+#include "replication/origin.h"
+#include "storage/dsm.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/lmgr.h"
+#include "storage/proc.h"
+#include "storage/shm_mq.h"
+#include "storage/shm_toc.h"
+#include "storage/spin.h"
+#include "tcop/tcopprot.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/resowner.h"
+#include "utils/snapmgr.h"
+#include "utils/timestamp.h"
+#include "utils/typcache.h"
+
+#define LOGICALREP_APPLY_MAGIC			0x6c726170
+#define LOGICALREP_APPLY_QUEUE_SIZE		(1024 * 1024)
+#define LOGICALREP_APPLY_KEY_SHARED		0
+#define LOGICALREP_APPLY_KEY_QUEUE(i)	((i) + 1)
+
+/* Send feedback to the publisher at least this often (ms) */
+#define LOGICALREP_FEEDBACK_INTERVAL	10000
+
+/* Forget keys of committed transactions when there are more than this */
+#define LOGICALREP_MAX_KEYS				100000
+
+/* The leader's view of a subscription */
+typedef struct LogicalRepSubscription
+{
+	int			subid;
+	char	   *name;
+	char	   *conninfo;
+	char	   *slot_name;
+	char	   *pubnames;		/* publications as a list of identifiers */
+	char	   *pubarray;		/* ... and as a text[] literal */
+	bool		enabled;
+	bool		copy_data;
+	bool		synced;
+	int			apply_workers;
+	int			sync_workers;
+} LogicalRepSubscription;
+
+/* State of an apply worker, in shared memory */
+typedef struct ApplyWorkerState
+{
+	bool		busy;			/* has a transaction been handed to it? */
+	uint64		seq;			/* ... and its number */
+	TransactionId xid;			/* its local xid, once started */
+	PGPROC	   *proc;
+} ApplyWorkerState;
+
+/* Shared memory of a leader and its apply workers */
+typedef struct ApplyShared
+{
+	slock_t		mutex;			/* protects the fields below */
+	Oid			dbid;
+	int			subid;
+	int			nworkers;
+	int			nattached;		/* workers that picked their queue */
+	uint64		committed_seq;	/* everything up to this has committed */
+	PGPROC	   *leader;
+	ApplyWorkerState workers[FLEXIBLE_ARRAY_MEMBER];
+} ApplyShared;
+
+/* A unique index of a target table, for the leader */
+typedef struct LogicalRepUniqueKey
+{
+	Oid			indexoid;
+	int			nkeys;
+	int		   *remoteatts;		/* indexes of the remote columns */
+} LogicalRepUniqueKey;
+
+/* How to apply changes of a remote relation to the local one */
+typedef struct LogicalRepRelMapEntry
+{
+	uint32		remoteid;		/* hash key, must be first */
+	LogicalRepRelation *remoterel;
+	bool		valid;
+	MemoryContext cxt;			/* holds everything below */
+	Oid			localreloid;
+	AttrNumber *attmap;			/* local attnum of each remote column */
+	bool		fullident;		/* replica identity FULL? */
+
+	/* used by the leader */
+	bool		serialize;		/* apply changes in commit order? */
+	int			nidentatts;
+	int		   *identatts;		/* remote columns of the replica identity */
+	List	   *uniquekeys;		/* LogicalRepUniqueKey */
+
+	/* used by the apply workers */
+	Oid		   *atttypes;
+	int32	   *atttypmods;
+	FmgrInfo   *attinfuncs;
+	Oid		   *atttypioparams;
+	bool	   *atthaseq;		/* can values be compared with "="? */
+	SPIPlanPtr	insert_plan;
+	SPIPlanPtr	update_plan;
+	SPIPlanPtr	delete_plan;
+} LogicalRepRelMapEntry;
+
+/* The last transaction to use a key, for the leader */
+typedef struct ApplyKeyEntry
+{
+	uint32		hash;			/* hash key, must be first */
+	uint64		seq;
+} ApplyKeyEntry;
+
+static bool am_leader = false;
+static ApplyShared *shared = NULL;
+static HTAB *LogicalRepRelMap = NULL;
+static MemoryContext LogicalRepRelMapContext = NULL;
+
+/* Leader state */
+static LogicalRepSubscription *MySubscription = NULL;
+static RepOriginId *originids = NULL;
+static shm_mq_handle **queues = NULL;
+static BackgroundWorkerHandle **handles = NULL;
+static HTAB *KeyHash = NULL;
+static int	cur_worker = -1;	/* worker of the current transaction */
+static uint64 cur_seq = 0;		/* number of the current transaction */
+static XLogRecPtr last_received = InvalidXLogRecPtr;
+static XLogRecPtr idle_lsn = InvalidXLogRecPtr;
+static TimestampTz last_feedback = 0;
+
+/* Apply worker state */
+static int	MyWorkerNo = -1;
+static uint64 my_seq = 0;
+static MemoryContext ApplyMessageContext = NULL;
+
+static void relmap_init(void);
+static void relmap_invalidate_cb(Datum arg, Oid reloid);
+static void relmap_update(LogicalRepRelation *remoterel);
+static LogicalRepRelMapEntry *relmap_open(uint32 remoteid, LOCKMODE lockmode,
+			Relation *relp);
+static void relmap_build(LogicalRepRelMapEntry *entry, Relation rel);
+static void relmap_build_keys(LogicalRepRelMapEntry *entry, Relation rel);
+
+static LogicalRepSubscription *leader_load_subscription(int subid);
+static void leader_initial_sync(PGconn *conn);
+static void leader_start_workers(Oid dbid);
+static void leader_start_streaming(PGconn *conn);
+static void leader_stream(PGconn *conn) pg_attribute_noreturn();
+static void leader_handle_copydata(PGconn *conn, char *buf, int len);
+static void leader_handle_message(PGconn *conn, StringInfo s);
+static void leader_forward(uint64 tag, StringInfo s);
+static int	leader_wait_for_worker(PGconn *conn);
+static uint64 leader_compute_dependency(char action, StringInfo s);
+static bool leader_hash_key(LogicalRepRelMapEntry *entry, Oid indexoid,
+				int nkeys, int *atts, LogicalRepTupleData *tup,
+				uint32 *hash, bool *unknown);
+static void leader_add_key(uint32 hash, uint64 *dep);
+static void leader_forget_keys(void);
+static void leader_check_workers(void);
+static bool leader_is_idle(void);
+static void leader_send_feedback(PGconn *conn, bool force);
+
+static void apply_dispatch(uint64 tag, StringInfo s);
+static void apply_handle_begin(uint64 seq, StringInfo s);
+static void apply_handle_commit(StringInfo s);
+static void apply_handle_change(char action, uint64 dep, StringInfo s);
+static void apply_wait_for_seq(uint64 seq);
+static void apply_wakeup_all(void);
+static void apply_insert(LogicalRepRelMapEntry *entry, Relation rel,
+			 LogicalRepTupleData *newtup);
+static void apply_update(LogicalRepRelMapEntry *entry, Relation rel,
+			 LogicalRepTupleData *keytup, LogicalRepTupleData *newtup);
+static void apply_delete(LogicalRepRelMapEntry *entry, Relation rel,
+			 LogicalRepTupleData *keytup);
+static int apply_key_clause(StringInfo sql, LogicalRepRelMapEntry *entry,
+				 Relation rel, LogicalRepTupleData *keytup, int nparams,
+				 Oid *types, Datum *values, char *nulls, bool *cacheable);
+static void apply_execute(SPIPlanPtr *cached, const char *sql, int nparams,
+			  Oid *types, Datum *values, char *nulls, bool cacheable,
+			  int expected);
+
+
+/*
+ * Relation map, shared by the leader and the workers.
+ */
+
+static void
+relmap_init(void)
+{
+	HASHCTL		ctl;
+
+	LogicalRepRelMapContext = AllocSetContextCreate(TopMemoryContext,
+											"logicalrep relation map",
+													ALLOCSET_DEFAULT_MINSIZE,
+												   ALLOCSET_DEFAULT_INITSIZE,
+												   ALLOCSET_DEFAULT_MAXSIZE);
+
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(uint32);
+	ctl.entrysize = sizeof(LogicalRepRelMapEntry);
+	ctl.hcxt = LogicalRepRelMapContext;
+	LogicalRepRelMap = hash_create("logicalrep relation map", 128, &ctl,
+								   HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	CacheRegisterRelcacheCallback(relmap_invalidate_cb, (Datum) 0);
+}
+
+/*
+ * Local DDL may change how changes map to a table; look again next time.
+ */
+static void
+relmap_invalidate_cb(Datum arg, Oid reloid)
+{
+	HASH_SEQ_STATUS status;
+	LogicalRepRelMapEntry *entry;
+
+	hash_seq_init(&status, LogicalRepRelMap);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		if (reloid == InvalidOid || entry->localreloid == reloid)
+			entry->valid = false;
+	}
+}
+
+/*
+ * Remember the description of a remote relation, which must have been
+ * allocated in LogicalRepRelMapContext.
+ */
+static void
+relmap_update(LogicalRepRelation *remoterel)
+{
+	LogicalRepRelMapEntry *entry;
+	LogicalRepRelation *oldrel;
+	bool		found;
+	bool		same;
+	int			i;
+
+	entry = hash_search(LogicalRepRelMap, &remoterel->remoteid, HASH_ENTER,
+						&found);
+	if (!found)
+	{
+		entry->remoterel = remoterel;
+		entry->valid = false;
+		entry->cxt = NULL;
+		entry->localreloid = InvalidOid;
+		entry->insert_plan = NULL;
+		entry->update_plan = NULL;
+		entry->delete_plan = NULL;
+		return;
+	}
+
+	oldrel = entry->remoterel;
+	same = (strcmp(oldrel->nspname, remoterel->nspname) == 0 &&
+			strcmp(oldrel->relname, remoterel->relname) == 0 &&
+			oldrel->natts == remoterel->natts);
+	for (i = 0; same && i < oldrel->natts; i++)
+	{
+		if (strcmp(oldrel->attnames[i], remoterel->attnames[i]) != 0 ||
+			oldrel->attkeys[i] != remoterel->attkeys[i])
+			same = false;
+	}
+
+	if (same)
+	{
+		/* the usual case; keep what we have */
+		oldrel = remoterel;
+	}
+	else
+	{
+		entry->remoterel = remoterel;
+		entry->valid = false;
+	}
+
+	for (i = 0; i < oldrel->natts; i++)
+		pfree(oldrel->attnames[i]);
+	pfree(oldrel->attnames);
+	pfree(oldrel->attkeys);
+	pfree(oldrel->nspname);
+	pfree(oldrel->relname);
+	pfree(oldrel);
+}
+
+/*
+ * Open the local relation that changes of a remote relation go to, making
+ * sure the map entry is up to date.  Must be called in a transaction.
+ */
+static LogicalRepRelMapEntry *
+relmap_open(uint32 remoteid, LOCKMODE lockmode, Relation *relp)
+{
+	LogicalRepRelMapEntry *entry;
+	Oid			relid;
+	Relation	rel;
+
+	entry = hash_search(LogicalRepRelMap, &remoteid, HASH_FIND, NULL);
+	if (entry == NULL)
+		elog(ERROR, "no relation map entry for remote relation ID %u",
+			 remoteid);
+
+	/* the name is looked up every time, in case the table was replaced */
+	relid = RangeVarGetRelid(makeRangeVar(entry->remoterel->nspname,
+										  entry->remoterel->relname, -1),
+							 lockmode, true);
+	if (!OidIsValid(relid))
+		ereport(ERROR,
+				(errcode(ERRCODE_UNDEFINED_OBJECT),
+				 errmsg("logical replication target relation \"%s.%s\" does not exist",
+						entry->remoterel->nspname,
+						entry->remoterel->relname)));
+
+	rel = heap_open(relid, NoLock);
+	if (rel->rd_rel->relkind != RELKIND_RELATION)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("logical replication target relation \"%s.%s\" is not a table",
+						entry->remoterel->nspname,
+						entry->remoterel->relname)));
+
+	if (!entry->valid || entry->localreloid != relid)
+		relmap_build(entry, rel);
+
+	*relp = rel;
+	return entry;
+}
+
+/*
+ * Work out how the columns of the remote relation map to the local one.
+ */
+static void
+relmap_build(LogicalRepRelMapEntry *entry, Relation rel)
+{
+	LogicalRepRelation *remoterel = entry->remoterel;
+	TupleDesc	desc = RelationGetDescr(rel);
+	MemoryContext oldcxt;
+	int			i;
+
+	if (entry->insert_plan)
+		SPI_freeplan(entry->insert_plan);
+	if (entry->update_plan)
+		SPI_freeplan(entry->update_plan);
+	if (entry->delete_plan)
+		SPI_freeplan(entry->delete_plan);
+	entry->insert_plan = entry->update_plan = entry->delete_plan = NULL;
+	if (entry->cxt)
+		MemoryContextDelete(entry->cxt);
+	entry->valid = false;
+
+	entry->cxt = AllocSetContextCreate(LogicalRepRelMapContext,
+									   "logicalrep relation",
+									   ALLOCSET_SMALL_MINSIZE,
+									   ALLOCSET_SMALL_INITSIZE,
+									   ALLOCSET_SMALL_MAXSIZE);
+	oldcxt = MemoryContextSwitchTo(entry->cxt);
+
+	entry->localreloid = RelationGetRelid(rel);
+	entry->attmap = palloc(remoterel->natts * sizeof(AttrNumber));
+	entry->fullident = remoterel->natts > 0;
+	entry->nidentatts = 0;
+	entry->identatts = palloc(remoterel->natts * sizeof(int));
+
+	for (i = 0; i < remoterel->natts; i++)
+	{
+		int			j;
+
+		for (j = 0; j < desc->natts; j++)
+		{
+			if (!desc->attrs[j]->attisdropped &&
+				strcmp(NameStr(desc->attrs[j]->attname),
+					   remoterel->attnames[i]) == 0)
+				break;
+		}
+		if (j >= desc->natts)
+			ereport(ERROR,
+					(errcode(ERRCODE_UNDEFINED_COLUMN),
+					 errmsg("logical replication target relation \"%s.%s\" is missing column \"%s\"",
+							remoterel->nspname, remoterel->relname,
+							remoterel->attnames[i])));
+		entry->attmap[i] = j + 1;
+
+		if (remoterel->attkeys[i])
+			entry->identatts[entry->nidentatts++] = i;
+		else
+			entry->fullident = false;
+	}
+
+	if (am_leader)
+		relmap_build_keys(entry, rel);
+	else
+	{
+		entry->atttypes = palloc(remoterel->natts * sizeof(Oid));
+		entry->atttypmods = palloc(remoterel->natts * sizeof(int32));
+		entry->attinfuncs = palloc(remoterel->natts * sizeof(FmgrInfo));
+		entry->atttypioparams = palloc(remoterel->natts * sizeof(Oid));
+		entry->atthaseq = palloc(remoterel->natts * sizeof(bool));
+
+		for (i = 0; i < remoterel->natts; i++)
+		{
+			Form_pg_attribute att = desc->attrs[entry->attmap[i] - 1];
+			TypeCacheEntry *typentry;
+			Oid			infunc;
+
+			entry->atttypes[i] = att->atttypid;
+			entry->atttypmods[i] = att->atttypmod;
+			getTypeInputInfo(att->atttypid, &infunc,
+							 &entry->atttypioparams[i]);
+			fmgr_info_cxt(infunc, &entry->attinfuncs[i], entry->cxt);
+			typentry = lookup_type_cache(att->atttypid, TYPECACHE_EQ_OPR);
+			entry->atthaseq[i] = OidIsValid(typentry->eq_opr);
+		}
+	}
+
+	MemoryContextSwitchTo(oldcxt);
+	entry->valid = true;
+}
+
+/*
+ * Collect the unique indexes of the local table, as the leader needs them
+ * to find out which changes depend on each other.
+ */
+static void
+relmap_build_keys(LogicalRepRelMapEntry *entry, Relation rel)
+{
+	List	   *indexoids = RelationGetIndexList(rel);
+	ListCell   *lc;
+
+	entry->serialize = false;
+	entry->uniquekeys = NIL;
+
+	foreach(lc, indexoids)
+	{
+		Relation	idxrel = index_open(lfirst_oid(lc), AccessShareLock);
+		Form_pg_index idx = idxrel->rd_index;
+
+		if (idx->indisexclusion)
+			entry->serialize = true;
+		else if (idx->indisunique)
+		{
+			if (!heap_attisnull(idxrel->rd_indextuple, Anum_pg_index_indexprs) ||
+				!heap_attisnull(idxrel->rd_indextuple, Anum_pg_index_indpred))
+				entry->serialize = true;
+			else
+			{
+				LogicalRepUniqueKey *key = palloc(sizeof(LogicalRepUniqueKey));
+				int			k;
+
+				key->indexoid = RelationGetRelid(idxrel);
+				key->nkeys = idx->indnatts;
+				key->remoteatts = palloc(key->nkeys * sizeof(int));
+				for (k = 0; k < key->nkeys; k++)
+				{
+					int			i;
+
+					for (i = 0; i < entry->remoterel->natts; i++)
+					{
+						if (entry->attmap[i] == idx->indkey.values[k])
+							break;
+					}
+					/* a column the publisher doesn't send gets a default */
+					if (i >= entry->remoterel->natts)
+						entry->serialize = true;
+					key->remoteatts[k] = i;
+				}
+				entry->uniquekeys = lappend(entry->uniquekeys, key);
+			}
+		}
+
+		index_close(idxrel, AccessShareLock);
+	}
+}
+
+
+/*
+ * The leader.
+ */
+
+void
+logicalrep_leader_main(Datum main_arg)
+{
+	Oid			dbid;
+	int			subid;
+	PGconn	   *conn;
+
+	pqsignal(SIGTERM, die);
+	BackgroundWorkerUnblockSignals();
+
+	logicalrep_leader_attach(DatumGetInt32(main_arg), &dbid, &subid);
+	BackgroundWorkerInitializeConnectionByOid(dbid, InvalidOid);
+	am_leader = true;
+
+	/*
+	 * Hold the subscription's lock for as long as we run, so that dropping
+	 * the subscription can wait for us to be gone.
+	 */
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+	logicalrep_lock_subscription(subid, true);
+	MySubscription = leader_load_subscription(subid);
+	CommitTransactionCommand();
+
+	if (MySubscription == NULL || !MySubscription->enabled)
+		proc_exit(0);
+
+	relmap_init();
+
+	pgstat_report_activity(STATE_RUNNING, "connecting to the publisher");
+	conn = logicalrep_connect(MySubscription->conninfo, true,
+							  MySubscription->name);
+
+	if (!MySubscription->synced)
+		leader_initial_sync(conn);
+
+	leader_start_workers(dbid);
+	leader_start_streaming(conn);
+	leader_stream(conn);
+}
+
+/*
+ * Read the subscription and look up its origins.  Returns NULL if it's gone.
+ */
+static LogicalRepSubscription *
+leader_load_subscription(int subid)
+{
+	LogicalRepSubscription *sub = NULL;
+	Oid			argtypes[1] = {INT4OID};
+	Datum		args[1];
+	bool		isnull;
+	int			ret;
+	int			i;
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "SPI_connect failed");
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	args[0] = Int32GetDatum(subid);
+	ret = SPI_execute_with_args("SELECT subname, conninfo, slot_name, "
+		"array_to_string(ARRAY(SELECT quote_ident(p) FROM unnest(publications) p), ','), "
+								"publications::text, enabled, copy_data, "
+								"synced, apply_workers, sync_workers "
+								"FROM logicalrep.subscription "
+								"WHERE subid = $1",
+								1, argtypes, args, NULL, true, 0);
+	if (ret != SPI_OK_SELECT)
+		elog(ERROR, "SPI_execute failed: %s", SPI_result_code_string(ret));
+
+	if (SPI_processed > 0)
+	{
+		HeapTuple	tup = SPI_tuptable->vals[0];
+		TupleDesc	desc = SPI_tuptable->tupdesc;
+
+		sub = MemoryContextAllocZero(TopMemoryContext,
+									 sizeof(LogicalRepSubscription));
+		sub->subid = subid;
+		sub->name = MemoryContextStrdup(TopMemoryContext,
+										SPI_getvalue(tup, desc, 1));
+		sub->conninfo = MemoryContextStrdup(TopMemoryContext,
+											SPI_getvalue(tup, desc, 2));
+		sub->slot_name = MemoryContextStrdup(TopMemoryContext,
+											 SPI_getvalue(tup, desc, 3));
+		sub->pubnames = MemoryContextStrdup(TopMemoryContext,
+											SPI_getvalue(tup, desc, 4));
+		sub->pubarray = MemoryContextStrdup(TopMemoryContext,
+											SPI_getvalue(tup, desc, 5));
+		sub->enabled = DatumGetBool(SPI_getbinval(tup, desc, 6, &isnull));
+		sub->copy_data = DatumGetBool(SPI_getbinval(tup, desc, 7, &isnull));
+		sub->synced = DatumGetBool(SPI_getbinval(tup, desc, 8, &isnull));
+		sub->apply_workers = DatumGetInt32(SPI_getbinval(tup, desc, 9,
+														 &isnull));
+		sub->sync_workers = DatumGetInt32(SPI_getbinval(tup, desc, 10,
+														&isnull));
+
+		originids = MemoryContextAlloc(TopMemoryContext,
+									   sub->apply_workers * sizeof(RepOriginId));
+		for (i = 0; i < sub->apply_workers; i++)
+			originids[i] = replorigin_by_name(logicalrep_origin_name(subid, i),
+											  false);
+	}
+
+	SPI_finish();
+	PopActiveSnapshot();
+
+	return sub;
+}
+
+/*
+ * Create the replication slot and, if asked to, copy the existing contents
+ * of the published tables as of the moment the slot was created.
+ *
+ * If we don't copy the data we can use a slot that exists already, say
+ * because the user created it to retain changes since then.  Otherwise we
+ * need the snapshot that comes with a new slot.
+ */
+static void
+leader_initial_sync(PGconn *conn)
+{
+	LogicalRepSubscription *sub = MySubscription;
+	XLogRecPtr	startpoint = InvalidXLogRecPtr;
+	PGresult   *res;
+	char	   *cmd;
+	int			ret;
+
+	pgstat_report_activity(STATE_RUNNING, "creating replication slot");
+
+	if (sub->copy_data)
+	{
+		/* a slot left behind by an earlier failed attempt is useless */
+		cmd = psprintf("DROP_REPLICATION_SLOT %s",
+					   quote_identifier(sub->slot_name));
+		res = logicalrep_exec(conn, cmd, 0, NULL);
+		PQclear(res);
+	}
+
+	cmd = psprintf("CREATE_REPLICATION_SLOT %s LOGICAL logicalrep",
+				   quote_identifier(sub->slot_name));
+	res = logicalrep_exec(conn, cmd, 0, NULL);
+	if (PQresultStatus(res) == PGRES_TUPLES_OK)
+	{
+		uint32		hi,
+					lo;
+
+		if (sscanf(PQgetvalue(res, 0, 1), "%X/%X", &hi, &lo) != 2)
+			elog(ERROR, "could not parse consistent point \"%s\"",
+				 PQgetvalue(res, 0, 1));
+		startpoint = ((uint64) hi) << 32 | lo;
+
+		if (sub->copy_data)
+		{
+			pgstat_report_activity(STATE_RUNNING, "copying tables");
+			logicalrep_sync_tables(sub->conninfo, PQgetvalue(res, 0, 2),
+								   sub->pubarray, sub->sync_workers);
+		}
+	}
+	else
+	{
+		const char *sqlstate = PQresultErrorField(res, PG_DIAG_SQLSTATE);
+
+		if (sub->copy_data || sqlstate == NULL ||
+			strcmp(sqlstate, "42710") != 0)		/* duplicate_object */
+			ereport(ERROR,
+					(errcode(ERRCODE_CONNECTION_FAILURE),
+					 errmsg("could not create replication slot \"%s\": %s",
+							sub->slot_name, PQresultErrorMessage(res))));
+	}
+	PQclear(res);
+
+	/* start replicating where the copy left off */
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "SPI_connect failed");
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	ret = SPI_execute(psprintf("UPDATE logicalrep.subscription "
+							   "SET synced = true WHERE subid = %d",
+							   sub->subid), false, 0);
+	if (ret != SPI_OK_UPDATE)
+		elog(ERROR, "SPI_execute failed: %s", SPI_result_code_string(ret));
+
+	if (startpoint != InvalidXLogRecPtr)
+	{
+		LockRelationOid(ReplicationOriginRelationId, RowExclusiveLock);
+		replorigin_advance(originids[0], startpoint, InvalidXLogRecPtr,
+						   true, true);
+	}
+
+	SPI_finish();
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+
+	sub->synced = true;
+}
+
+/*
+ * Set up the shared memory and start the apply workers.
+ */
+static void
+leader_start_workers(Oid dbid)
+{
+	int			nworkers = MySubscription->apply_workers;
+	HASHCTL		ctl;
+	shm_toc_estimator e;
+	Size		sharedsize;
+	Size		segsize;
+	dsm_segment *seg;
+	shm_toc    *toc;
+	int			i;
+
+	sharedsize = offsetof(ApplyShared, workers) +
+		nworkers * sizeof(ApplyWorkerState);
+
+	shm_toc_initialize_estimator(&e);
+	shm_toc_estimate_chunk(&e, sharedsize);
+	for (i = 0; i < nworkers; i++)
+		shm_toc_estimate_chunk(&e, LOGICALREP_APPLY_QUEUE_SIZE);
+	shm_toc_estimate_keys(&e, 1 + nworkers);
+	segsize = shm_toc_estimate(&e);
+
+	/* the segment lives as long as we do */
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, "logicalrep leader");
+	seg = dsm_create(segsize, 0);
+	dsm_pin_mapping(seg);
+	toc = shm_toc_create(LOGICALREP_APPLY_MAGIC, dsm_segment_address(seg),
+						 segsize);
+
+	shared = shm_toc_allocate(toc, sharedsize);
+	memset(shared, 0, sharedsize);
+	SpinLockInit(&shared->mutex);
+	shared->dbid = dbid;
+	shared->subid = MySubscription->subid;
+	shared->nworkers = nworkers;
+	shared->leader = MyProc;
+	shm_toc_insert(toc, LOGICALREP_APPLY_KEY_SHARED, shared);
+
+	queues = MemoryContextAlloc(TopMemoryContext,
+								nworkers * sizeof(shm_mq_handle *));
+	handles = MemoryContextAlloc(TopMemoryContext,
+								 nworkers * sizeof(BackgroundWorkerHandle *));
+	for (i = 0; i < nworkers; i++)
+	{
+		shm_mq	   *mq;
+
+		mq = shm_mq_create(shm_toc_allocate(toc, LOGICALREP_APPLY_QUEUE_SIZE),
+						   LOGICALREP_APPLY_QUEUE_SIZE);
+		shm_toc_insert(toc, LOGICALREP_APPLY_KEY_QUEUE(i), mq);
+		shm_mq_set_sender(mq, MyProc);
+
+		handles[i] = logicalrep_start_child(psprintf("logicalrep apply %d/%d",
+												  MySubscription->subid, i),
+											"logicalrep_apply_main",
+							   UInt32GetDatum(dsm_segment_handle(seg)));
+		queues[i] = shm_mq_attach(mq, seg, handles[i]);
+	}
+
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(uint32);
+	ctl.entrysize = sizeof(ApplyKeyEntry);
+	KeyHash = hash_create("logicalrep apply keys", 1024, &ctl,
+						  HASH_ELEM | HASH_BLOBS);
+}
+
+/*
+ * Ask the publisher to start sending changes after what we've applied.
+ */
+static void
+leader_start_streaming(PGconn *conn)
+{
+	XLogRecPtr	startpos = InvalidXLogRecPtr;
+	PGresult   *res;
+	char	   *cmd;
+	int			i;
+
+	for (i = 0; i < MySubscription->apply_workers; i++)
+	{
+		XLogRecPtr	pos = replorigin_get_progress(originids[i], false);
+
+		if (pos > startpos)
+			startpos = pos;
+	}
+
+	cmd = psprintf("START_REPLICATION SLOT %s LOGICAL %X/%X "
+				   "(proto_version '%d', publication_names %s)",
+				   quote_identifier(MySubscription->slot_name),
+				   (uint32) (startpos >> 32), (uint32) startpos,
+				   LOGICALREP_PROTO_VERSION,
+				   quote_literal_cstr(MySubscription->pubnames));
+	res = logicalrep_exec(conn, cmd, 0, NULL);
+	if (PQresultStatus(res) != PGRES_COPY_BOTH)
+		ereport(ERROR,
+				(errcode(ERRCODE_CONNECTION_FAILURE),
+				 errmsg("could not start replication from the publisher: %s",
+						PQresultErrorMessage(res))));
+	PQclear(res);
+
+	pgstat_report_activity(STATE_RUNNING, "streaming");
+}
+
+/*
+ * Receive changes and hand them to the apply workers, forever.
+ */
+static void
+leader_stream(PGconn *conn)
+{
+	MemoryContext messagecxt;
+
+	messagecxt = AllocSetContextCreate(TopMemoryContext,
+									   "logicalrep leader message",
+									   ALLOCSET_DEFAULT_MINSIZE,
+									   ALLOCSET_DEFAULT_INITSIZE,
+									   ALLOCSET_DEFAULT_MAXSIZE);
+
+	for (;;)
+	{
+		char	   *buf = NULL;
+		int			len;
+		int			rc;
+
+		CHECK_FOR_INTERRUPTS();
+
+		for (;;)
+		{
+			len = PQgetCopyData(conn, &buf, 1);
+			if (len == 0)
+				break;
+			if (len == -1)
+				ereport(ERROR,
+						(errcode(ERRCODE_CONNECTION_FAILURE),
+						 errmsg("the publisher ended the replication stream")));
+			if (len < -1)
+				ereport(ERROR,
+						(errcode(ERRCODE_CONNECTION_FAILURE),
+						 errmsg("could not receive data from the publisher: %s",
+								PQerrorMessage(conn))));
+
+			MemoryContextSwitchTo(messagecxt);
+			leader_handle_copydata(conn, buf, len);
+			MemoryContextSwitchTo(TopMemoryContext);
+			MemoryContextReset(messagecxt);
+			PQfreemem(buf);
+		}
+
+		leader_send_feedback(conn, false);
+		leader_check_workers();
+
+		rc = WaitLatchOrSocket(MyLatch,
+							   WL_LATCH_SET | WL_SOCKET_READABLE |
+							   WL_TIMEOUT | WL_POSTMASTER_DEATH,
+							   PQsocket(conn), 1000L);
+		ResetLatch(MyLatch);
+
+		if (rc & WL_POSTMASTER_DEATH)
+			proc_exit(1);
+
+		if (PQconsumeInput(conn) == 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_CONNECTION_FAILURE),
+					 errmsg("could not receive data from the publisher: %s",
+							PQerrorMessage(conn))));
+	}
+}
+
+/*
+ * Handle one CopyData message of the streaming replication protocol.
+ */
+static void
+leader_handle_copydata(PGconn *conn, char *buf, int len)
+{
+	StringInfoData s;
+
+	s.data = buf;
+	s.len = len;
+	s.maxlen = len;
+	s.cursor = 0;
+
+	switch (pq_getmsgbyte(&s))
+	{
+		case 'w':
+			{
+				XLogRecPtr	start = pq_getmsgint64(&s);
+				StringInfoData msg;
+
+				(void) pq_getmsgint64(&s);		/* walEnd */
+				(void) pq_getmsgint64(&s);		/* sendTime */
+
+				if (start > last_received)
+					last_received = start;
+
+				msg.data = s.data + s.cursor;
+				msg.len = s.len - s.cursor;
+				msg.maxlen = msg.len;
+				msg.cursor = 0;
+				leader_handle_message(conn, &msg);
+				break;
+			}
+		case 'k':
+			{
+				XLogRecPtr	walEnd = pq_getmsgint64(&s);
+				bool		replyRequested;
+
+				(void) pq_getmsgint64(&s);		/* sendTime */
+				replyRequested = pq_getmsgbyte(&s);
+
+				if (walEnd > last_received)
+					last_received = walEnd;
+
+				/*
+				 * Everything the publisher sent before this has been
+				 * applied, so it needn't resend any of it.
+				 */
+				if (leader_is_idle())
+					idle_lsn = walEnd;
+
+				if (replyRequested)
+					leader_send_feedback(conn, true);
+				break;
+			}
+		default:
+			ereport(ERROR,
+					(errcode(ERRCODE_PROTOCOL_VIOLATION),
+					 errmsg("unexpected message type \"%c\" from the publisher",
+							buf[0])));
+	}
+}
+
+/*
+ * Hand a message of the logical replication protocol to an apply worker.
+ * Each is prefixed with a number: for a BEGIN the number of the
+ * transaction, for a change the transaction it has to wait for, if any.
+ */
+static void
+leader_handle_message(PGconn *conn, StringInfo s)
+{
+	char		action = pq_getmsgbyte(s);
+
+	switch (action)
+	{
+		case 'B':
+			if (cur_worker >= 0)
+				elog(ERROR, "BEGIN received inside a transaction");
+			cur_seq++;
+			cur_worker = leader_wait_for_worker(conn);
+			leader_forward(cur_seq, s);
+			break;
+		case 'C':
+			if (cur_worker < 0)
+				elog(ERROR, "COMMIT received outside a transaction");
+			leader_forward(0, s);
+			cur_worker = -1;
+			leader_forget_keys();
+			break;
+		case 'R':
+			{
+				LogicalRepRelation *remoterel;
+				LogicalRepRelMapEntry *entry;
+				MemoryContext oldcxt;
+				Relation	rel;
+
+				if (cur_worker < 0)
+					elog(ERROR, "relation received outside a transaction");
+
+				oldcxt = MemoryContextSwitchTo(LogicalRepRelMapContext);
+				remoterel = logicalrep_read_rel(s);
+				MemoryContextSwitchTo(oldcxt);
+				relmap_update(remoterel);
+
+				/* starting a transaction also processes invalidations */
+				StartTransactionCommand();
+				entry = hash_search(LogicalRepRelMap, &remoterel->remoteid,
+									HASH_FIND, NULL);
+				if (!entry->valid)
+				{
+					entry = relmap_open(remoterel->remoteid, AccessShareLock,
+										&rel);
+					heap_close(rel, NoLock);
+				}
+				CommitTransactionCommand();
+
+				leader_forward(0, s);
+				break;
+			}
+		case 'I':
+		case 'U':
+		case 'D':
+			if (cur_worker < 0)
+				elog(ERROR, "change received outside a transaction");
+			leader_forward(leader_compute_dependency(action, s), s);
+			break;
+		default:
+			ereport(ERROR,
+					(errcode(ERRCODE_PROTOCOL_VIOLATION),
+					 errmsg("unexpected logical replication message type \"%c\"",
+							action)));
+	}
+}
+
+static void
+leader_forward(uint64 tag, StringInfo s)
+{
+	shm_mq_iovec iov[2];
+
+	iov[0].data = (char *) &tag;
+	iov[0].len = sizeof(tag);
+	iov[1].data = s->data;
+	iov[1].len = s->len;
+
+	if (shm_mq_sendv(queues[cur_worker], iov, 2, false) != SHM_MQ_SUCCESS)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("logicalrep apply worker %d of subscription \"%s\" exited unexpectedly",
+						cur_worker, MySubscription->name)));
+}
+
+/*
+ * Wait until a worker is free, and give it the current transaction.
+ */
+static int
+leader_wait_for_worker(PGconn *conn)
+{
+	for (;;)
+	{
+		int			i;
+		int			rc;
+
+		SpinLockAcquire(&shared->mutex);
+		for (i = 0; i < shared->nworkers; i++)
+		{
+			if (!shared->workers[i].busy)
+			{
+				shared->workers[i].busy = true;
+				shared->workers[i].seq = cur_seq;
+				shared->workers[i].xid = InvalidTransactionId;
+				SpinLockRelease(&shared->mutex);
+				return i;
+			}
+		}
+		SpinLockRelease(&shared->mutex);
+
+		/* keep the publisher from thinking we're gone */
+		leader_send_feedback(conn, false);
+		leader_check_workers();
+
+		rc = WaitLatch(MyLatch,
+					   WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+					   1000L);
+		ResetLatch(MyLatch);
+
+		if (rc & WL_POSTMASTER_DEATH)
+			proc_exit(1);
+
+		CHECK_FOR_INTERRUPTS();
+	}
+}
+
+/*
+ * Work out which earlier transaction a change has to wait for, and
+ * remember the keys it uses.  Returns 0 if it needn't wait.
+ */
+static uint64
+leader_compute_dependency(char action, StringInfo s)
+{
+	LogicalRepTupleData oldtup;
+	LogicalRepTupleData newtup;
+	LogicalRepTupleData *oldkey = NULL;
+	LogicalRepTupleData *newrow = NULL;
+	LogicalRepRelMapEntry *entry;
+	uint32		remoteid;
+	bool		has_oldtuple;
+	bool		unknown = false;
+	uint64		dep = 0;
+	uint32		hash;
+	ListCell   *lc;
+
+	switch (action)
+	{
+		case 'I':
+			remoteid = logicalrep_read_insert(s, &newtup);
+			newrow = &newtup;
+			break;
+		case 'U':
+			remoteid = logicalrep_read_update(s, &has_oldtuple, &oldtup,
+											  &newtup);
+			if (has_oldtuple)
+				oldkey = &oldtup;
+			newrow = &newtup;
+			break;
+		case 'D':
+			remoteid = logicalrep_read_delete(s, &oldtup);
+			oldkey = &oldtup;
+			break;
+		default:
+			elog(ERROR, "unexpected action \"%c\"", action);
+	}
+
+	entry = hash_search(LogicalRepRelMap, &remoteid, HASH_FIND, NULL);
+	if (entry == NULL || !entry->valid)
+		elog(ERROR, "no relation map entry for remote relation ID %u",
+			 remoteid);
+
+	if (entry->serialize)
+		return cur_seq - 1;
+
+	if (oldkey && entry->nidentatts > 0 &&
+		leader_hash_key(entry, InvalidOid, entry->nidentatts,
+						entry->identatts, oldkey, &hash, &unknown))
+		leader_add_key(hash, &dep);
+
+	if (newrow)
+	{
+		if (entry->nidentatts > 0 &&
+			leader_hash_key(entry, InvalidOid, entry->nidentatts,
+							entry->identatts, newrow, &hash, &unknown))
+			leader_add_key(hash, &dep);
+
+		foreach(lc, entry->uniquekeys)
+		{
+			LogicalRepUniqueKey *key = lfirst(lc);
+
+			if (leader_hash_key(entry, key->indexoid, key->nkeys,
+								key->remoteatts, newrow, &hash, &unknown))
+				leader_add_key(hash, &dep);
+		}
+	}
+
+	if (unknown)
+		return cur_seq - 1;
+
+	return dep;
+}
+
+/*
+ * Hash the values of some columns of a tuple, along with the table and the
+ * index they belong to.  Returns false if a value is NULL, as such a key
+ * can't conflict with anything, and also if a value wasn't sent, in which
+ * case *unknown is set.
+ */
+static bool
+leader_hash_key(LogicalRepRelMapEntry *entry, Oid indexoid, int nkeys,
+				int *atts, LogicalRepTupleData *tup, uint32 *hash,
+				bool *unknown)
+{
+	StringInfoData buf;
+	int			k;
+
+	initStringInfo(&buf);
+	appendBinaryStringInfo(&buf, (char *) &entry->localreloid, sizeof(Oid));
+	appendBinaryStringInfo(&buf, (char *) &indexoid, sizeof(Oid));
+
+	for (k = 0; k < nkeys; k++)
+	{
+		int			i = atts[k];
+		int			len;
+
+		if (i >= tup->natts || tup->status[i] == LOGICALREP_COLUMN_UNCHANGED)
+		{
+			*unknown = true;
+			return false;
+		}
+		if (tup->status[i] == LOGICALREP_COLUMN_NULL)
+			return false;
+
+		len = strlen(tup->values[i]);
+		appendBinaryStringInfo(&buf, (char *) &len, sizeof(int));
+		appendBinaryStringInfo(&buf, tup->values[i], len);
+	}
+
+	*hash = DatumGetUInt32(hash_any((unsigned char *) buf.data, buf.len));
+	pfree(buf.data);
+
+	return true;
+}
+
+/*
+ * Record that the current transaction uses a key, and note the latest
+ * other transaction that used it.
+ */
+static void
+leader_add_key(uint32 hash, uint64 *dep)
+{
+	ApplyKeyEntry *entry;
+	bool		found;
+
+	entry = hash_search(KeyHash, &hash, HASH_ENTER, &found);
+	if (found && entry->seq != cur_seq && entry->seq > *dep)
+		*dep = entry->seq;
+	entry->seq = cur_seq;
+}
+
+/*
+ * Don't let the keys of committed transactions pile up.
+ */
+static void
+leader_forget_keys(void)
+{
+	HASH_SEQ_STATUS status;
+	ApplyKeyEntry *entry;
+	uint64		committed_seq;
+
+	if (hash_get_num_entries(KeyHash) <= LOGICALREP_MAX_KEYS)
+		return;
+
+	SpinLockAcquire(&shared->mutex);
+	committed_seq = shared->committed_seq;
+	SpinLockRelease(&shared->mutex);
+
+	hash_seq_init(&status, KeyHash);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		if (entry->seq <= committed_seq)
+			hash_search(KeyHash, &entry->hash, HASH_REMOVE, NULL);
+	}
+}
+
+/*
+ * Give up if a worker died; we'll be restarted, and start over from the
+ * last transaction committed.
+ */
+static void
+leader_check_workers(void)
+{
+	int			i;
+
+	for (i = 0; i < MySubscription->apply_workers; i++)
+	{
+		pid_t		pid;
+
+		switch (GetBackgroundWorkerPid(handles[i], &pid))
+		{
+			case BGWH_STOPPED:
+				ereport(ERROR,
+						(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+						 errmsg("logicalrep apply worker %d of subscription \"%s\" exited unexpectedly",
+								i, MySubscription->name)));
+				break;
+			case BGWH_POSTMASTER_DIED:
+				proc_exit(1);
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+/*
+ * Has everything handed to the workers been committed?
+ */
+static bool
+leader_is_idle(void)
+{
+	uint64		committed_seq;
+
+	if (cur_worker >= 0)
+		return false;
+
+	SpinLockAcquire(&shared->mutex);
+	committed_seq = shared->committed_seq;
+	SpinLockRelease(&shared->mutex);
+
+	return committed_seq == cur_seq;
+}
+
+/*
+ * Tell the publisher how far we got, so that it can recycle WAL.  Only
+ * what has been committed and flushed locally is confirmed.
+ */
+static void
+leader_send_feedback(PGconn *conn, bool force)
+{
+	TimestampTz now = GetCurrentTimestamp();
+	XLogRecPtr	flushpos = InvalidXLogRecPtr;
+	StringInfoData buf;
+	int			i;
+
+	if (!force &&
+		!TimestampDifferenceExceeds(last_feedback, now,
+									LOGICALREP_FEEDBACK_INTERVAL))
+		return;
+
+	for (i = 0; i < MySubscription->apply_workers; i++)
+	{
+		XLogRecPtr	pos = replorigin_get_progress(originids[i], true);
+
+		if (pos > flushpos)
+			flushpos = pos;
+	}
+	if (idle_lsn > flushpos)
+		flushpos = idle_lsn;
+
+	initStringInfo(&buf);
+	pq_sendbyte(&buf, 'r');
+	pq_sendint64(&buf, last_received);	/* write */
+	pq_sendint64(&buf, flushpos);		/* flush */
+	pq_sendint64(&buf, flushpos);		/* apply */
+	pq_sendint64(&buf, GetCurrentIntegerTimestamp());
+	pq_sendbyte(&buf, false);			/* replyRequested */
+
+	if (PQputCopyData(conn, buf.data, buf.len) <= 0 || PQflush(conn) != 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_CONNECTION_FAILURE),
+				 errmsg("could not send feedback to the publisher: %s",
+						PQerrorMessage(conn))));
+	pfree(buf.data);
+
+	last_feedback = now;
+}
+
+
+/*
+ * The apply workers.
+ */
+
+void
+logicalrep_apply_main(Datum main_arg)
+{
+	dsm_segment *seg;
+	shm_toc    *toc;
+	shm_mq	   *mq;
+	shm_mq_handle *mqh;
+	RepOriginId originid;
+
+	pqsignal(SIGTERM, die);
+	BackgroundWorkerUnblockSignals();
+
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, "logicalrep apply");
+	seg = dsm_attach(DatumGetUInt32(main_arg));
+	if (seg == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("could not map dynamic shared memory segment")));
+	dsm_pin_mapping(seg);
+	toc = shm_toc_attach(LOGICALREP_APPLY_MAGIC, dsm_segment_address(seg));
+	if (toc == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("bad magic number in dynamic shared memory segment")));
+	shared = shm_toc_lookup(toc, LOGICALREP_APPLY_KEY_SHARED);
+
+	SpinLockAcquire(&shared->mutex);
+	MyWorkerNo = shared->nattached++;
+	if (MyWorkerNo < shared->nworkers)
+		shared->workers[MyWorkerNo].proc = MyProc;
+	SpinLockRelease(&shared->mutex);
+	if (MyWorkerNo >= shared->nworkers)
+		proc_exit(0);
+
+	mq = shm_toc_lookup(toc, LOGICALREP_APPLY_KEY_QUEUE(MyWorkerNo));
+	shm_mq_set_receiver(mq, MyProc);
+	mqh = shm_mq_attach(mq, seg, NULL);
+
+	BackgroundWorkerInitializeConnectionByOid(shared->dbid, InvalidOid);
+
+	/* don't fire triggers and rules, nor check foreign keys */
+	SetConfigOption("session_replication_role", "replica",
+					PGC_SUSET, PGC_S_OVERRIDE);
+
+	StartTransactionCommand();
+	originid = replorigin_by_name(logicalrep_origin_name(shared->subid,
+														 MyWorkerNo),
+								  false);
+	CommitTransactionCommand();
+	replorigin_session_setup(originid);
+	replorigin_sesssion_origin = originid;
+
+	relmap_init();
+	ApplyMessageContext = AllocSetContextCreate(TopMemoryContext,
+												"logicalrep apply message",
+												ALLOCSET_DEFAULT_MINSIZE,
+												ALLOCSET_DEFAULT_INITSIZE,
+												ALLOCSET_DEFAULT_MAXSIZE);
+	pgstat_report_activity(STATE_IDLE, NULL);
+
+	for (;;)
+	{
+		shm_mq_result res;
+		Size		len;
+		void	   *data;
+		uint64		tag;
+		StringInfoData s;
+
+		CHECK_FOR_INTERRUPTS();
+
+		res = shm_mq_receive(mqh, &len, &data, false);
+		if (res != SHM_MQ_SUCCESS)
+			break;				/* the leader is gone */
+
+		if (len < sizeof(tag) + 1)
+			elog(ERROR, "invalid message from logicalrep leader");
+		memcpy(&tag, data, sizeof(tag));
+		s.data = (char *) data + sizeof(tag);
+		s.len = len - sizeof(tag);
+		s.maxlen = s.len;
+		s.cursor = 0;
+
+		MemoryContextSwitchTo(ApplyMessageContext);
+		apply_dispatch(tag, &s);
+		MemoryContextSwitchTo(TopMemoryContext);
+		MemoryContextReset(ApplyMessageContext);
+	}
+
+	proc_exit(0);
+}
+
+static void
+apply_dispatch(uint64 tag, StringInfo s)
+{
+	char		action = pq_getmsgbyte(s);
+
+	switch (action)
+	{
+		case 'B':
+			apply_handle_begin(tag, s);
+			break;
+		case 'C':
+			apply_handle_commit(s);
+			break;
+		case 'R':
+			{
+				LogicalRepRelation *remoterel;
+				MemoryContext oldcxt;
+
+				oldcxt = MemoryContextSwitchTo(LogicalRepRelMapContext);
+				remoterel = logicalrep_read_rel(s);
+				MemoryContextSwitchTo(oldcxt);
+				relmap_update(remoterel);
+				break;
+			}
+		case 'I':
+		case 'U':
+		case 'D':
+			apply_handle_change(action, tag, s);
+			break;
+		default:
+			elog(ERROR, "unexpected logical replication message type \"%c\"",
+				 action);
+	}
+}
+
+/*
+ * Start a local transaction for a remote one.  An xid is assigned at once,
+ * so that workers applying later transactions can wait for it, and so that
+ * the commit always records our progress.
+ */
+static void
+apply_handle_begin(uint64 seq, StringInfo s)
+{
+	LogicalRepBeginData begin;
+	TransactionId xid;
+
+	logicalrep_read_begin(s, &begin);
+	my_seq = seq;
+
+	pgstat_report_activity(STATE_RUNNING, "applying remote transaction");
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+	xid = GetTopTransactionId();
+
+	SpinLockAcquire(&shared->mutex);
+	shared->workers[MyWorkerNo].xid = xid;
+	SpinLockRelease(&shared->mutex);
+	apply_wakeup_all();
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "SPI_connect failed");
+}
+
+/*
+ * Commit, once all earlier transactions have.
+ */
+static void
+apply_handle_commit(StringInfo s)
+{
+	LogicalRepCommitData commit;
+
+	logicalrep_read_commit(s, &commit);
+
+	apply_wait_for_seq(my_seq - 1);
+
+	SPI_finish();
+	replorigin_sesssion_origin_lsn = commit.end_lsn;
+	replorigin_sesssion_origin_timestamp = commit.committime;
+	CommitTransactionCommand();
+	pgstat_report_stat(false);
+
+	SpinLockAcquire(&shared->mutex);
+	Assert(shared->committed_seq == my_seq - 1);
+	shared->committed_seq = my_seq;
+	shared->workers[MyWorkerNo].busy = false;
+	shared->workers[MyWorkerNo].xid = InvalidTransactionId;
+	SpinLockRelease(&shared->mutex);
+	apply_wakeup_all();
+
+	pgstat_report_activity(STATE_IDLE, NULL);
+}
+
+static void
+apply_handle_change(char action, uint64 dep, StringInfo s)
+{
+	LogicalRepTupleData oldtup;
+	LogicalRepTupleData newtup;
+	LogicalRepRelMapEntry *entry;
+	Relation	rel;
+	uint32		remoteid;
+	bool		has_oldtuple = false;
+
+	switch (action)
+	{
+		case 'I':
+			remoteid = logicalrep_read_insert(s, &newtup);
+			break;
+		case 'U':
+			remoteid = logicalrep_read_update(s, &has_oldtuple, &oldtup,
+											  &newtup);
+			break;
+		case 'D':
+			remoteid = logicalrep_read_delete(s, &oldtup);
+			has_oldtuple = true;
+			break;
+		default:
+			elog(ERROR, "unexpected action \"%c\"", action);
+	}
+
+	if (dep > 0)
+		apply_wait_for_seq(dep);
+
+	PushActiveSnapshot(GetTransactionSnapshot());
+	entry = relmap_open(remoteid, RowExclusiveLock, &rel);
+
+	if ((action != 'D' && newtup.natts != entry->remoterel->natts) ||
+		(has_oldtuple && oldtup.natts != entry->remoterel->natts))
+		elog(ERROR, "wrong number of columns for relation \"%s.%s\"",
+			 entry->remoterel->nspname, entry->remoterel->relname);
+
+	switch (action)
+	{
+		case 'I':
+			apply_insert(entry, rel, &newtup);
+			break;
+		case 'U':
+			apply_update(entry, rel, has_oldtuple ? &oldtup : &newtup,
+						 &newtup);
+			break;
+		case 'D':
+			apply_delete(entry, rel, &oldtup);
+			break;
+	}
+
+	heap_close(rel, NoLock);
+	PopActiveSnapshot();
+}
+
+/*
+ * Wait until transaction number seq, and all before it, have committed.
+ *
+ * We wait on the lock of the transaction next in line, so that the deadlock
+ * detector knows about it, then on our latch for it to report its commit.
+ */
+static void
+apply_wait_for_seq(uint64 seq)
+{
+	for (;;)
+	{
+		TransactionId xid = InvalidTransactionId;
+		uint64		committed_seq;
+		int			rc;
+		int			i;
+
+		SpinLockAcquire(&shared->mutex);
+		committed_seq = shared->committed_seq;
+		if (committed_seq < seq)
+		{
+			for (i = 0; i < shared->nworkers; i++)
+			{
+				if (shared->workers[i].busy &&
+					shared->workers[i].seq == committed_seq + 1)
+					xid = shared->workers[i].xid;
+			}
+		}
+		SpinLockRelease(&shared->mutex);
+
+		if (committed_seq >= seq)
+			return;
+
+		if (TransactionIdIsValid(xid))
+			XactLockTableWait(xid, NULL, NULL, XLTW_None);
+
+		rc = WaitLatch(MyLatch,
+					   WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+					   1000L);
+		ResetLatch(MyLatch);
+
+		if (rc & WL_POSTMASTER_DEATH)
+			proc_exit(1);
+
+		CHECK_FOR_INTERRUPTS();
+	}
+}
+
+/*
+ * Wake up the leader and the other workers, as one of them may be waiting
+ * for what we just did.
+ */
+static void
+apply_wakeup_all(void)
+{
+	int			i;
+
+	SetLatch(&shared->leader->procLatch);
+	for (i = 0; i < shared->nworkers; i++)
+	{
+		PGPROC	   *proc = shared->workers[i].proc;
+
+		if (proc != NULL && i != MyWorkerNo)
+			SetLatch(&proc->procLatch);
+	}
+}
+
+static char *
+apply_relname(Relation rel)
+{
+	return quote_qualified_identifier(get_namespace_name(RelationGetNamespace(rel)),
+									  RelationGetRelationName(rel));
+}
+
+static const char *
+apply_colname(LogicalRepRelMapEntry *entry, Relation rel, int i)
+{
+	Form_pg_attribute att = RelationGetDescr(rel)->attrs[entry->attmap[i] - 1];
+
+	return quote_identifier(NameStr(att->attname));
+}
+
+static void
+apply_value(LogicalRepRelMapEntry *entry, LogicalRepTupleData *tup, int i,
+			Datum *value, char *null)
+{
+	if (tup->status[i] == LOGICALREP_COLUMN_TEXT)
+	{
+		*value = InputFunctionCall(&entry->attinfuncs[i], tup->values[i],
+								   entry->atttypioparams[i],
+								   entry->atttypmods[i]);
+		*null = ' ';
+	}
+	else
+	{
+		*value = (Datum) 0;
+		*null = 'n';
+	}
+}
+
+static void
+apply_insert(LogicalRepRelMapEntry *entry, Relation rel,
+			 LogicalRepTupleData *newtup)
+{
+	int			natts = entry->remoterel->natts;
+	Datum	   *values = palloc(natts * sizeof(Datum));
+	char	   *nulls = palloc(natts * sizeof(char));
+	StringInfoData sql;
+	int			i;
+
+	initStringInfo(&sql);
+	appendStringInfo(&sql, "INSERT INTO %s ", apply_relname(rel));
+	if (natts == 0)
+		appendStringInfoString(&sql, "DEFAULT VALUES");
+	else
+	{
+		appendStringInfoChar(&sql, '(');
+		for (i = 0; i < natts; i++)
+			appendStringInfo(&sql, "%s%s", i > 0 ? ", " : "",
+							 apply_colname(entry, rel, i));
+		appendStringInfoString(&sql, ") VALUES (");
+		for (i = 0; i < natts; i++)
+			appendStringInfo(&sql, "%s$%d", i > 0 ? ", " : "", i + 1);
+		appendStringInfoChar(&sql, ')');
+	}
+
+	for (i = 0; i < natts; i++)
+	{
+		if (newtup->status[i] == LOGICALREP_COLUMN_UNCHANGED)
+			elog(ERROR, "unchanged value in insert into \"%s\"",
+				 RelationGetRelationName(rel));
+		apply_value(entry, newtup, i, &values[i], &nulls[i]);
+	}
+
+	apply_execute(&entry->insert_plan, sql.data, natts, entry->atttypes,
+				  values, nulls, true, SPI_OK_INSERT);
+}
+
+/*
+ * Values that weren't sent are left alone.  The key of the row is that of
+ * keytup, which is the new tuple unless the key changed.
+ */
+static void
+apply_update(LogicalRepRelMapEntry *entry, Relation rel,
+			 LogicalRepTupleData *keytup, LogicalRepTupleData *newtup)
+{
+	int			natts = entry->remoterel->natts;
+	Oid		   *types = palloc(2 * natts * sizeof(Oid));
+	Datum	   *values = palloc(2 * natts * sizeof(Datum));
+	char	   *nulls = palloc(2 * natts * sizeof(char));
+	bool		cacheable = true;
+	int			nparams = 0;
+	StringInfoData sql;
+	int			i;
+
+	initStringInfo(&sql);
+	appendStringInfo(&sql, "UPDATE %s SET ", apply_relname(rel));
+	for (i = 0; i < natts; i++)
+	{
+		if (newtup->status[i] == LOGICALREP_COLUMN_UNCHANGED)
+		{
+			cacheable = false;
+			continue;
+		}
+		types[nparams] = entry->atttypes[i];
+		apply_value(entry, newtup, i, &values[nparams], &nulls[nparams]);
+		nparams++;
+		appendStringInfo(&sql, "%s%s = $%d", nparams > 1 ? ", " : "",
+						 apply_colname(entry, rel, i), nparams);
+	}
+	if (nparams == 0)
+		return;
+
+	appendStringInfoString(&sql, " WHERE ");
+	nparams = apply_key_clause(&sql, entry, rel, keytup, nparams,
+							   types, values, nulls, &cacheable);
+
+	apply_execute(&entry->update_plan, sql.data, nparams, types, values,
+				  nulls, cacheable, SPI_OK_UPDATE);
+	if (SPI_processed == 0)
+		elog(DEBUG1, "logical replication did not find row to update in \"%s\"",
+			 RelationGetRelationName(rel));
+}
+
+static void
+apply_delete(LogicalRepRelMapEntry *entry, Relation rel,
+			 LogicalRepTupleData *keytup)
+{
+	int			natts = entry->remoterel->natts;
+	Oid		   *types = palloc(natts * sizeof(Oid));
+	Datum	   *values = palloc(natts * sizeof(Datum));
+	char	   *nulls = palloc(natts * sizeof(char));
+	bool		cacheable = true;
+	int			nparams;
+	StringInfoData sql;
+
+	initStringInfo(&sql);
+	appendStringInfo(&sql, "DELETE FROM %s WHERE ", apply_relname(rel));
+	nparams = apply_key_clause(&sql, entry, rel, keytup, 0,
+							   types, values, nulls, &cacheable);
+
+	apply_execute(&entry->delete_plan, sql.data, nparams, types, values,
+				  nulls, cacheable, SPI_OK_DELETE);
+	if (SPI_processed == 0)
+		elog(DEBUG1, "logical replication did not find row to delete in \"%s\"",
+			 RelationGetRelationName(rel));
+}
+
+/*
+ * Append the conditions that find the row with the key in keytup, adding
+ * their parameters after the first nparams.  Returns the new number of
+ * parameters.  *cacheable is cleared if the conditions depend on which
+ * values are NULL or were sent.
+ *
+ * With REPLICA IDENTITY FULL there may be several identical rows, of which
+ * we change only one.
+ */
+static int
+apply_key_clause(StringInfo sql, LogicalRepRelMapEntry *entry, Relation rel,
+				 LogicalRepTupleData *keytup, int nparams, Oid *types,
+				 Datum *values, char *nulls, bool *cacheable)
+{
+	StringInfoData cond;
+	int			nkeys = 0;
+	int			i;
+
+	initStringInfo(&cond);
+	for (i = 0; i < entry->remoterel->natts; i++)
+	{
+		if (!entry->remoterel->attkeys[i] || !entry->atthaseq[i])
+			continue;
+		if (keytup->status[i] == LOGICALREP_COLUMN_UNCHANGED)
+		{
+			*cacheable = false;
+			continue;
+		}
+
+		if (nkeys++ > 0)
+			appendStringInfoString(&cond, " AND ");
+		if (keytup->status[i] == LOGICALREP_COLUMN_NULL)
+		{
+			appendStringInfo(&cond, "%s IS NULL",
+							 apply_colname(entry, rel, i));
+			*cacheable = false;
+			continue;
+		}
+		types[nparams] = entry->atttypes[i];
+		apply_value(entry, keytup, i, &values[nparams], &nulls[nparams]);
+		nparams++;
+		appendStringInfo(&cond, "%s = $%d", apply_colname(entry, rel, i),
+						 nparams);
+	}
+
+	if (nkeys == 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("logical replication target relation \"%s.%s\" has no usable key",
+						entry->remoterel->nspname,
+						entry->remoterel->relname),
+				 errhint("Set a replica identity on the publisher's table.")));
+
+	if (entry->fullident)
+		appendStringInfo(sql,
+			  "ctid = (SELECT ctid FROM %s WHERE %s LIMIT 1 FOR UPDATE)",
+						 apply_relname(rel), cond.data);
+	else
+		appendStringInfoString(sql, cond.data);
+	pfree(cond.data);
+
+	return nparams;
+}
+
+/*
+ * Run a change, with the plan saved in *cached if the statement is the one
+ * usually used for this kind of change.
+ */
+static void
+apply_execute(SPIPlanPtr *cached, const char *sql, int nparams, Oid *types,
+			  Datum *values, char *nulls, bool cacheable, int expected)
+{
+	int			ret;
+
+	if (cacheable)
+	{
+		if (*cached == NULL)
+		{
+			SPIPlanPtr	plan = SPI_prepare(sql, nparams, types);
+
+			if (plan == NULL)
+				elog(ERROR, "SPI_prepare(\"%s\") failed: %s",
+					 sql, SPI_result_code_string(SPI_result));
+			if (SPI_keepplan(plan))
+				elog(ERROR, "SPI_keepplan failed");
+			*cached = plan;
+		}
+		ret = SPI_execute_plan(*cached, values, nulls, false, 0);
+	}
+	else
+		ret = SPI_execute_with_args(sql, nparams, types, values, nulls,
+									false, 0);
+
+	if (ret != expected)
+		elog(ERROR, "failed to apply change \"%s\": %s",
+			 sql, SPI_result_code_string(ret));
+}
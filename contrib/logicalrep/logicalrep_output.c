@@ -0,0 +1,512 @@
+/*-------------------------------------------------------------------------
+ *
+ * logicalrep_output.c
+ *		  logical decoding output plugin of the logicalrep module
+ *
+ * The plugin sends the changes of the tables in the requested publications
+ * in the binary protocol described in logicalrep_proto.c.  Transactions
+ * that changed no published table are not sent at all.
+ *
+ * Publications live in the logicalrep.publication and
+ * logicalrep.publication_rel tables.  Both are user catalog tables, so they
+ * can be read here under the historic snapshot, and a trigger on them sends
+ * a relcache invalidation for the table itself when they are modified,
+ * which tells us to reload them.
+ *
+ * Copyright (c) 2015, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		  contrib/logicalrep/logicalrep_output.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "logicalrep.h"
+
+#include "access/genam.h"
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "access/transam.h"
+#include "catalog/namespace.h"
+#include "commands/dbcommands.h"
+#include "miscadmin.h"
+#include "nodes/parsenodes.h"
+#include "replication/logical.h"
+#include "replication/output_plugin.h"
+#include "utils/builtins.h"
+#include "utils/catcache.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+
+/* These must be available to pg_dlsym() */
+extern void _PG_output_plugin_init(OutputPluginCallbacks *cb);
+
+typedef struct
+{
+	MemoryContext context;		/* reset after every change */
+	List	   *publications;	/* names of the publications to send */
+	bool		sent_begin;		/* did we send BEGIN for this transaction? */
+} LogicalRepOutputData;
+
+/*
+ * Whether, and in which transaction, each relation was last sent.  The
+ * cache survives between decoding sessions of one backend, since a relcache
+ * callback can't be unregistered, but is invalidated when a session starts.
+ */
+typedef struct RelationSyncEntry
+{
+	Oid			relid;			/* hash key */
+	bool		valid;			/* is publish up to date? */
+	bool		publish;		/* are the relation's changes sent? */
+	uint32		sent_generation;	/* last transaction the 'R' was sent in */
+} RelationSyncEntry;
+
+static HTAB *RelationSyncCache = NULL;
+static MemoryContext PublicationContext = NULL;
+static uint32 xact_generation = 0;
+
+/* What the publication tables said, when publications_valid */
+static bool publications_valid = false;
+static Oid	logicalrep_nspid = InvalidOid;
+static Oid	publication_reloid = InvalidOid;
+static Oid	publication_rel_reloid = InvalidOid;
+static bool publish_all_tables = false;
+static List *published_rels = NIL;
+
+static void logicalrep_decode_startup(LogicalDecodingContext *ctx,
+						  OutputPluginOptions *opt, bool is_init);
+static void logicalrep_decode_shutdown(LogicalDecodingContext *ctx);
+static void logicalrep_decode_begin_txn(LogicalDecodingContext *ctx,
+							ReorderBufferTXN *txn);
+static void logicalrep_decode_commit_txn(LogicalDecodingContext *ctx,
+							 ReorderBufferTXN *txn, XLogRecPtr commit_lsn);
+static void logicalrep_decode_change(LogicalDecodingContext *ctx,
+						 ReorderBufferTXN *txn, Relation rel,
+						 ReorderBufferChange *change);
+
+static void init_rel_sync_cache(void);
+static RelationSyncEntry *get_rel_sync_entry(LogicalRepOutputData *data,
+				   Relation rel);
+static void load_publications(LogicalRepOutputData *data);
+static void rel_sync_cache_relation_cb(Datum arg, Oid relid);
+
+/* specify output plugin callbacks */
+void
+_PG_output_plugin_init(OutputPluginCallbacks *cb)
+{
+	AssertVariableIsOfType(&_PG_output_plugin_init, LogicalOutputPluginInit);
+
+	cb->startup_cb = logicalrep_decode_startup;
+	cb->begin_cb = logicalrep_decode_begin_txn;
+	cb->change_cb = logicalrep_decode_change;
+	cb->commit_cb = logicalrep_decode_commit_txn;
+	cb->shutdown_cb = logicalrep_decode_shutdown;
+}
+
+/* initialize this plugin */
+static void
+logicalrep_decode_startup(LogicalDecodingContext *ctx,
+						  OutputPluginOptions *opt, bool is_init)
+{
+	LogicalRepOutputData *data;
+	ListCell   *option;
+	bool		got_proto_version = false;
+	char	   *publication_names = NULL;
+
+	data = palloc0(sizeof(LogicalRepOutputData));
+	data->context = AllocSetContextCreate(ctx->context,
+										  "logicalrep output context",
+										  ALLOCSET_DEFAULT_MINSIZE,
+										  ALLOCSET_DEFAULT_INITSIZE,
+										  ALLOCSET_DEFAULT_MAXSIZE);
+	ctx->output_plugin_private = data;
+
+	opt->output_type = OUTPUT_PLUGIN_BINARY_OUTPUT;
+
+	foreach(option, ctx->output_plugin_options)
+	{
+		DefElem    *elem = lfirst(option);
+
+		Assert(elem->arg == NULL || IsA(elem->arg, String));
+
+		if (elem->arg == NULL)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("option \"%s\" requires a value",
+							elem->defname)));
+
+		if (strcmp(elem->defname, "proto_version") == 0)
+		{
+			int			version = pg_atoi(strVal(elem->arg), 4, 0);
+
+			if (version != LOGICALREP_PROTO_VERSION)
+				ereport(ERROR,
+						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						 errmsg("protocol version %d is not supported, only version %d is",
+								version, LOGICALREP_PROTO_VERSION)));
+			got_proto_version = true;
+		}
+		else if (strcmp(elem->defname, "publication_names") == 0)
+			publication_names = pstrdup(strVal(elem->arg));
+		else
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("option \"%s\" = \"%s\" is unknown",
+							elem->defname, strVal(elem->arg))));
+	}
+
+	/* Creating the slot doesn't decode anything, so needs no options */
+	if (is_init)
+		return;
+
+	if (!got_proto_version)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("option \"%s\" is required", "proto_version")));
+	if (publication_names == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("option \"%s\" is required", "publication_names")));
+
+	if (!SplitIdentifierString(publication_names, ',', &data->publications))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_NAME),
+				 errmsg("invalid publication name syntax")));
+
+	init_rel_sync_cache();
+}
+
+/* cleanup this plugin's resources */
+static void
+logicalrep_decode_shutdown(LogicalDecodingContext *ctx)
+{
+	LogicalRepOutputData *data = ctx->output_plugin_private;
+
+	/* cleanup our own resources via memory context reset */
+	MemoryContextDelete(data->context);
+}
+
+/*
+ * BEGIN callback.  BEGIN is only sent along with the first change of the
+ * transaction that we publish.
+ */
+static void
+logicalrep_decode_begin_txn(LogicalDecodingContext *ctx,
+							ReorderBufferTXN *txn)
+{
+	LogicalRepOutputData *data = ctx->output_plugin_private;
+
+	data->sent_begin = false;
+
+	/* zero means "never sent" */
+	if (++xact_generation == 0)
+		xact_generation = 1;
+}
+
+/* COMMIT callback */
+static void
+logicalrep_decode_commit_txn(LogicalDecodingContext *ctx,
+							 ReorderBufferTXN *txn, XLogRecPtr commit_lsn)
+{
+	LogicalRepOutputData *data = ctx->output_plugin_private;
+
+	if (!data->sent_begin)
+		return;
+
+	OutputPluginPrepareWrite(ctx, true);
+	logicalrep_write_commit(ctx->out, txn, commit_lsn);
+	OutputPluginWrite(ctx, true);
+}
+
+/*
+ * Send a change, preceded by BEGIN and the relation's description if they
+ * weren't sent yet in this transaction.
+ */
+static void
+logicalrep_decode_change(LogicalDecodingContext *ctx,
+						 ReorderBufferTXN *txn, Relation rel,
+						 ReorderBufferChange *change)
+{
+	LogicalRepOutputData *data = ctx->output_plugin_private;
+	RelationSyncEntry *entry;
+	HeapTuple	oldtuple;
+	HeapTuple	newtuple;
+	MemoryContext old;
+
+	entry = get_rel_sync_entry(data, rel);
+	if (!entry->publish)
+		return;
+
+	oldtuple = change->data.tp.oldtuple ?
+		&change->data.tp.oldtuple->tuple : NULL;
+	newtuple = change->data.tp.newtuple ?
+		&change->data.tp.newtuple->tuple : NULL;
+
+	/*
+	 * Without the old key, the subscriber has no way to find the row.  The
+	 * table's replica identity must be fixed on the publisher for that.
+	 */
+	if (change->action == REORDER_BUFFER_CHANGE_DELETE && oldtuple == NULL)
+	{
+		elog(DEBUG1, "not sending delete from \"%s\" without replica identity",
+			 RelationGetRelationName(rel));
+		return;
+	}
+
+	old = MemoryContextSwitchTo(data->context);
+
+	if (!data->sent_begin)
+	{
+		OutputPluginPrepareWrite(ctx, false);
+		logicalrep_write_begin(ctx->out, txn);
+		OutputPluginWrite(ctx, false);
+		data->sent_begin = true;
+	}
+
+	if (entry->sent_generation != xact_generation)
+	{
+		OutputPluginPrepareWrite(ctx, false);
+		logicalrep_write_rel(ctx->out, rel);
+		OutputPluginWrite(ctx, false);
+		entry->sent_generation = xact_generation;
+	}
+
+	OutputPluginPrepareWrite(ctx, true);
+	switch (change->action)
+	{
+		case REORDER_BUFFER_CHANGE_INSERT:
+			logicalrep_write_insert(ctx->out, rel, newtuple);
+			break;
+		case REORDER_BUFFER_CHANGE_UPDATE:
+			logicalrep_write_update(ctx->out, rel, oldtuple, newtuple);
+			break;
+		case REORDER_BUFFER_CHANGE_DELETE:
+			logicalrep_write_delete(ctx->out, rel, oldtuple);
+			break;
+		default:
+			Assert(false);
+	}
+	OutputPluginWrite(ctx, true);
+
+	MemoryContextSwitchTo(old);
+	MemoryContextReset(data->context);
+}
+
+/*
+ * Set up the relation cache, or forget what's in it if this backend has
+ * decoded before.  The publications asked for may be different this time.
+ */
+static void
+init_rel_sync_cache(void)
+{
+	HASHCTL		ctl;
+	HASH_SEQ_STATUS status;
+	RelationSyncEntry *entry;
+
+	publications_valid = false;
+
+	if (RelationSyncCache != NULL)
+	{
+		hash_seq_init(&status, RelationSyncCache);
+		while ((entry = hash_seq_search(&status)) != NULL)
+		{
+			entry->valid = false;
+			entry->sent_generation = 0;
+		}
+		return;
+	}
+
+	if (!CacheMemoryContext)
+		CreateCacheMemoryContext();
+
+	PublicationContext = AllocSetContextCreate(CacheMemoryContext,
+											   "logicalrep publications",
+											   ALLOCSET_SMALL_MINSIZE,
+											   ALLOCSET_SMALL_INITSIZE,
+											   ALLOCSET_SMALL_MAXSIZE);
+
+	MemSet(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(Oid);
+	ctl.entrysize = sizeof(RelationSyncEntry);
+	ctl.hcxt = CacheMemoryContext;
+	RelationSyncCache = hash_create("logicalrep relation sync cache", 128,
+									&ctl,
+									HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	CacheRegisterRelcacheCallback(rel_sync_cache_relation_cb, (Datum) 0);
+}
+
+/*
+ * Find or create the cache entry of a relation, deciding whether its
+ * changes are published if that isn't known.
+ */
+static RelationSyncEntry *
+get_rel_sync_entry(LogicalRepOutputData *data, Relation rel)
+{
+	Oid			relid = RelationGetRelid(rel);
+	RelationSyncEntry *entry;
+	bool		found;
+
+	entry = hash_search(RelationSyncCache, &relid, HASH_ENTER, &found);
+	if (!found)
+	{
+		entry->valid = false;
+		entry->sent_generation = 0;
+	}
+
+	if (!entry->valid)
+	{
+		if (!publications_valid)
+			load_publications(data);
+
+		/* the module's own tables are never published */
+		entry->publish =
+			rel->rd_rel->relkind == RELKIND_RELATION &&
+			relid >= FirstNormalObjectId &&
+			RelationGetNamespace(rel) != logicalrep_nspid &&
+			(publish_all_tables || list_member_oid(published_rels, relid));
+		entry->valid = true;
+	}
+
+	return entry;
+}
+
+/*
+ * Read the publications asked for from the publication tables.
+ */
+static void
+load_publications(LogicalRepOutputData *data)
+{
+	Relation	rel;
+	SysScanDesc scan;
+	HeapTuple	tup;
+	bool	   *found;
+	ListCell   *lc;
+	int			i;
+	MemoryContext old;
+
+	logicalrep_nspid = get_namespace_oid(LOGICALREP_SCHEMA, true);
+	publication_reloid = get_relname_relid("publication", logicalrep_nspid);
+	publication_rel_reloid = get_relname_relid("publication_rel",
+											   logicalrep_nspid);
+	if (!OidIsValid(publication_reloid) ||
+		!OidIsValid(publication_rel_reloid))
+		ereport(ERROR,
+				(errcode(ERRCODE_UNDEFINED_OBJECT),
+				 errmsg("extension \"logicalrep\" is not installed in database \"%s\"",
+						get_database_name(MyDatabaseId))));
+
+	MemoryContextReset(PublicationContext);
+	published_rels = NIL;
+	publish_all_tables = false;
+
+	found = palloc0(list_length(data->publications) * sizeof(bool));
+
+	rel = heap_open(publication_reloid, AccessShareLock);
+	scan = systable_beginscan(rel, InvalidOid, false, NULL, 0, NULL);
+	while (HeapTupleIsValid(tup = systable_getnext(scan)))
+	{
+		bool		isnull;
+		Name		pubname;
+		bool		all_tables;
+
+		pubname = DatumGetName(heap_getattr(tup, 1, RelationGetDescr(rel),
+											&isnull));
+		all_tables = DatumGetBool(heap_getattr(tup, 2, RelationGetDescr(rel),
+											   &isnull));
+
+		i = 0;
+		foreach(lc, data->publications)
+		{
+			if (strcmp(NameStr(*pubname), lfirst(lc)) == 0)
+			{
+				found[i] = true;
+				if (all_tables)
+					publish_all_tables = true;
+			}
+			i++;
+		}
+	}
+	systable_endscan(scan);
+	heap_close(rel, AccessShareLock);
+
+	i = 0;
+	foreach(lc, data->publications)
+	{
+		if (!found[i++])
+			ereport(ERROR,
+					(errcode(ERRCODE_UNDEFINED_OBJECT),
+					 errmsg("publication \"%s\" does not exist",
+							(char *) lfirst(lc))));
+	}
+
+	rel = heap_open(publication_rel_reloid, AccessShareLock);
+	scan = systable_beginscan(rel, InvalidOid, false, NULL, 0, NULL);
+	old = MemoryContextSwitchTo(PublicationContext);
+	while (HeapTupleIsValid(tup = systable_getnext(scan)))
+	{
+		bool		isnull;
+		Name		pubname;
+		Oid			relid;
+
+		pubname = DatumGetName(heap_getattr(tup, 1, RelationGetDescr(rel),
+											&isnull));
+		relid = DatumGetObjectId(heap_getattr(tup, 2, RelationGetDescr(rel),
+											  &isnull));
+
+		foreach(lc, data->publications)
+		{
+			if (strcmp(NameStr(*pubname), lfirst(lc)) == 0)
+			{
+				published_rels = lappend_oid(published_rels, relid);
+				break;
+			}
+		}
+	}
+	MemoryContextSwitchTo(old);
+	systable_endscan(scan);
+	heap_close(rel, AccessShareLock);
+
+	pfree(found);
+	publications_valid = true;
+}
+
+/*
+ * Relcache invalidation callback.  A change to the publication tables
+ * means every relation has to be looked at again; a change to a relation
+ * means its description has to be sent again.
+ */
+static void
+rel_sync_cache_relation_cb(Datum arg, Oid relid)
+{
+	HASH_SEQ_STATUS status;
+	RelationSyncEntry *entry;
+
+	if (RelationSyncCache == NULL)
+		return;
+
+	if (OidIsValid(relid) &&
+		relid != publication_reloid && relid != publication_rel_reloid)
+	{
+		entry = hash_search(RelationSyncCache, &relid, HASH_FIND, NULL);
+		if (entry != NULL)
+		{
+			entry->valid = false;
+			entry->sent_generation = 0;
+		}
+		return;
+	}
+
+	publications_valid = false;
+
+	hash_seq_init(&status, RelationSyncCache);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		entry->valid = false;
+		entry->sent_generation = 0;
+	}
+}
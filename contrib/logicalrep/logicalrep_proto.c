@@ -0,0 +1,395 @@
+/*-------------------------------------------------------------------------
+ *
+ * logicalrep_proto.c
+ *		  logical replication protocol functions
+ *
+ * The output plugin sends one message per call of OutputPluginWrite().
+ * Every message starts with a type byte:
+ *
+ *	'B'	begin: final LSN, commit time, remote xid
+ *	'C'	commit: flags, commit LSN, end LSN, commit time
+ *	'R'	relation: remote OID, schema and table name, and for each live
+ *		column a flags byte and its name
+ *	'I'	insert: remote OID, 'N' and the new tuple
+ *	'U'	update: remote OID, optionally 'K' and the old key, 'N' and the
+ *		new tuple
+ *	'D'	delete: remote OID, 'K' and the old key
+ *
+ * A tuple is a column count followed by, for each column, 'n' for NULL,
+ * 'u' for an unchanged TOASTed value that the publisher did not log, or 't'
+ * followed by the length and the value in text form.  A relation message
+ * precedes the first change to that relation in every transaction, so a
+ * transaction can be applied without knowing what was sent before it.
+ * Timestamps are sent as microseconds since the PostgreSQL epoch
+ * regardless of how the server stores them.
+ *
+ * Copyright (c) 2015, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		  contrib/logicalrep/logicalrep_proto.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "logicalrep.h"
+
+#include "access/heapam.h"
+#include "access/sysattr.h"
+#include "access/tuptoaster.h"
+#include "libpq/pqformat.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/syscache.h"
+
+static void logicalrep_write_tuple(StringInfo out, Relation rel,
+					   HeapTuple tuple);
+static void logicalrep_read_tuple(StringInfo in, LogicalRepTupleData *tuple);
+
+static void
+logicalrep_write_timestamp(StringInfo out, TimestampTz ts)
+{
+#ifdef HAVE_INT64_TIMESTAMP
+	pq_sendint64(out, ts);
+#else
+	pq_sendint64(out, (int64) (ts * USECS_PER_SEC));
+#endif
+}
+
+static TimestampTz
+logicalrep_read_timestamp(StringInfo in)
+{
+#ifdef HAVE_INT64_TIMESTAMP
+	return pq_getmsgint64(in);
+#else
+	return (TimestampTz) pq_getmsgint64(in) / USECS_PER_SEC;
+#endif
+}
+
+/*
+ * Write BEGIN to the output stream.
+ */
+void
+logicalrep_write_begin(StringInfo out, ReorderBufferTXN *txn)
+{
+	pq_sendbyte(out, 'B');
+	pq_sendint64(out, txn->final_lsn);
+	logicalrep_write_timestamp(out, txn->commit_time);
+	pq_sendint(out, txn->xid, 4);
+}
+
+/*
+ * Read BEGIN from the stream.
+ */
+void
+logicalrep_read_begin(StringInfo in, LogicalRepBeginData *begin)
+{
+	begin->final_lsn = pq_getmsgint64(in);
+	if (begin->final_lsn == InvalidXLogRecPtr)
+		elog(ERROR, "final_lsn not set in begin message");
+	begin->committime = logicalrep_read_timestamp(in);
+	begin->xid = pq_getmsgint(in, 4);
+}
+
+/*
+ * Write COMMIT to the output stream.
+ */
+void
+logicalrep_write_commit(StringInfo out, ReorderBufferTXN *txn,
+						XLogRecPtr commit_lsn)
+{
+	uint8		flags = 0;
+
+	pq_sendbyte(out, 'C');
+	pq_sendbyte(out, flags);
+	pq_sendint64(out, commit_lsn);
+	pq_sendint64(out, txn->end_lsn);
+	logicalrep_write_timestamp(out, txn->commit_time);
+}
+
+/*
+ * Read COMMIT from the stream.
+ */
+void
+logicalrep_read_commit(StringInfo in, LogicalRepCommitData *commit)
+{
+	uint8		flags = pq_getmsgbyte(in);
+
+	if (flags != 0)
+		elog(ERROR, "unknown flags %u in commit message", flags);
+
+	commit->commit_lsn = pq_getmsgint64(in);
+	commit->end_lsn = pq_getmsgint64(in);
+	commit->committime = logicalrep_read_timestamp(in);
+}
+
+/*
+ * Write a relation description to the output stream.
+ */
+void
+logicalrep_write_rel(StringInfo out, Relation rel)
+{
+	TupleDesc	desc = RelationGetDescr(rel);
+	Bitmapset  *idattrs = NULL;
+	bool		replidentfull;
+	int			nliveatts = 0;
+	int			i;
+
+	pq_sendbyte(out, 'R');
+	pq_sendint(out, RelationGetRelid(rel), 4);
+	pq_sendstring(out, get_namespace_name(RelationGetNamespace(rel)));
+	pq_sendstring(out, RelationGetRelationName(rel));
+
+	for (i = 0; i < desc->natts; i++)
+	{
+		if (!desc->attrs[i]->attisdropped)
+			nliveatts++;
+	}
+	pq_sendint(out, nliveatts, 2);
+
+	replidentfull = (rel->rd_rel->relreplident == REPLICA_IDENTITY_FULL);
+	if (!replidentfull)
+		idattrs = RelationGetIndexAttrBitmap(rel,
+											 INDEX_ATTR_BITMAP_IDENTITY_KEY);
+
+	for (i = 0; i < desc->natts; i++)
+	{
+		Form_pg_attribute att = desc->attrs[i];
+		uint8		flags = 0;
+
+		if (att->attisdropped)
+			continue;
+
+		if (replidentfull ||
+			bms_is_member(att->attnum - FirstLowInvalidHeapAttributeNumber,
+						  idattrs))
+			flags |= LOGICALREP_IS_KEY;
+
+		pq_sendbyte(out, flags);
+		pq_sendstring(out, NameStr(att->attname));
+	}
+
+	bms_free(idattrs);
+}
+
+/*
+ * Read a relation description from the stream.
+ */
+LogicalRepRelation *
+logicalrep_read_rel(StringInfo in)
+{
+	LogicalRepRelation *rel = palloc(sizeof(LogicalRepRelation));
+	int			i;
+
+	rel->remoteid = pq_getmsgint(in, 4);
+	rel->nspname = pstrdup(pq_getmsgstring(in));
+	rel->relname = pstrdup(pq_getmsgstring(in));
+	rel->natts = pq_getmsgint(in, 2);
+	rel->attnames = palloc(rel->natts * sizeof(char *));
+	rel->attkeys = palloc(rel->natts * sizeof(bool));
+
+	for (i = 0; i < rel->natts; i++)
+	{
+		uint8		flags = pq_getmsgbyte(in);
+
+		rel->attkeys[i] = (flags & LOGICALREP_IS_KEY) != 0;
+		rel->attnames[i] = pstrdup(pq_getmsgstring(in));
+	}
+
+	return rel;
+}
+
+/*
+ * Write INSERT to the output stream.
+ */
+void
+logicalrep_write_insert(StringInfo out, Relation rel, HeapTuple newtuple)
+{
+	pq_sendbyte(out, 'I');
+	pq_sendint(out, RelationGetRelid(rel), 4);
+	pq_sendbyte(out, 'N');
+	logicalrep_write_tuple(out, rel, newtuple);
+}
+
+/*
+ * Read INSERT from the stream, returning the remote relation OID.
+ */
+uint32
+logicalrep_read_insert(StringInfo in, LogicalRepTupleData *newtup)
+{
+	uint32		relid = pq_getmsgint(in, 4);
+
+	if (pq_getmsgbyte(in) != 'N')
+		elog(ERROR, "expected new tuple in insert message");
+	logicalrep_read_tuple(in, newtup);
+
+	return relid;
+}
+
+/*
+ * Write UPDATE to the output stream.  oldtuple is NULL if the key did not
+ * change and the relation's replica identity is not FULL.
+ */
+void
+logicalrep_write_update(StringInfo out, Relation rel, HeapTuple oldtuple,
+						HeapTuple newtuple)
+{
+	pq_sendbyte(out, 'U');
+	pq_sendint(out, RelationGetRelid(rel), 4);
+	if (oldtuple != NULL)
+	{
+		pq_sendbyte(out, 'K');
+		logicalrep_write_tuple(out, rel, oldtuple);
+	}
+	pq_sendbyte(out, 'N');
+	logicalrep_write_tuple(out, rel, newtuple);
+}
+
+/*
+ * Read UPDATE from the stream, returning the remote relation OID.
+ */
+uint32
+logicalrep_read_update(StringInfo in, bool *has_oldtuple,
+					   LogicalRepTupleData *oldtup,
+					   LogicalRepTupleData *newtup)
+{
+	uint32		relid = pq_getmsgint(in, 4);
+	int			action = pq_getmsgbyte(in);
+
+	*has_oldtuple = false;
+	if (action == 'K')
+	{
+		logicalrep_read_tuple(in, oldtup);
+		*has_oldtuple = true;
+		action = pq_getmsgbyte(in);
+	}
+	if (action != 'N')
+		elog(ERROR, "expected new tuple in update message, got '%c'", action);
+	logicalrep_read_tuple(in, newtup);
+
+	return relid;
+}
+
+/*
+ * Write DELETE to the output stream.
+ */
+void
+logicalrep_write_delete(StringInfo out, Relation rel, HeapTuple oldtuple)
+{
+	pq_sendbyte(out, 'D');
+	pq_sendint(out, RelationGetRelid(rel), 4);
+	pq_sendbyte(out, 'K');
+	logicalrep_write_tuple(out, rel, oldtuple);
+}
+
+/*
+ * Read DELETE from the stream, returning the remote relation OID.
+ */
+uint32
+logicalrep_read_delete(StringInfo in, LogicalRepTupleData *oldtup)
+{
+	uint32		relid = pq_getmsgint(in, 4);
+
+	if (pq_getmsgbyte(in) != 'K')
+		elog(ERROR, "expected key tuple in delete message");
+	logicalrep_read_tuple(in, oldtup);
+
+	return relid;
+}
+
+/*
+ * Write the live columns of a tuple in text form.
+ */
+static void
+logicalrep_write_tuple(StringInfo out, Relation rel, HeapTuple tuple)
+{
+	TupleDesc	desc = RelationGetDescr(rel);
+	Datum		values[MaxTupleAttributeNumber];
+	bool		isnull[MaxTupleAttributeNumber];
+	int			nliveatts = 0;
+	int			i;
+
+	for (i = 0; i < desc->natts; i++)
+	{
+		if (!desc->attrs[i]->attisdropped)
+			nliveatts++;
+	}
+	pq_sendint(out, nliveatts, 2);
+
+	heap_deform_tuple(tuple, desc, values, isnull);
+
+	for (i = 0; i < desc->natts; i++)
+	{
+		Form_pg_attribute att = desc->attrs[i];
+		Datum		value = values[i];
+		Oid			typoutput;
+		bool		typisvarlena;
+		char	   *outputstr;
+
+		if (att->attisdropped)
+			continue;
+
+		if (isnull[i])
+		{
+			pq_sendbyte(out, LOGICALREP_COLUMN_NULL);
+			continue;
+		}
+
+		if (att->attlen == -1)
+		{
+			/* the value was not changed, and so wasn't logged either */
+			if (VARATT_IS_EXTERNAL_ONDISK(DatumGetPointer(value)))
+			{
+				pq_sendbyte(out, LOGICALREP_COLUMN_UNCHANGED);
+				continue;
+			}
+			value = PointerGetDatum(PG_DETOAST_DATUM(value));
+		}
+
+		getTypeOutputInfo(att->atttypid, &typoutput, &typisvarlena);
+		outputstr = OidOutputFunctionCall(typoutput, value);
+
+		pq_sendbyte(out, LOGICALREP_COLUMN_TEXT);
+		pq_sendcountedtext(out, outputstr, strlen(outputstr), false);
+		pfree(outputstr);
+	}
+}
+
+/*
+ * Read a tuple written by logicalrep_write_tuple.
+ *
+ * The values are expected in the server encoding, which is why the apply
+ * side asks for it as client_encoding when connecting.
+ */
+static void
+logicalrep_read_tuple(StringInfo in, LogicalRepTupleData *tuple)
+{
+	int			i;
+
+	tuple->natts = pq_getmsgint(in, 2);
+	tuple->status = palloc(tuple->natts * sizeof(char));
+	tuple->values = palloc(tuple->natts * sizeof(char *));
+
+	for (i = 0; i < tuple->natts; i++)
+	{
+		char		status = pq_getmsgbyte(in);
+		int			len;
+
+		tuple->status[i] = status;
+		tuple->values[i] = NULL;
+
+		switch (status)
+		{
+			case LOGICALREP_COLUMN_NULL:
+			case LOGICALREP_COLUMN_UNCHANGED:
+				break;
+			case LOGICALREP_COLUMN_TEXT:
+				len = pq_getmsgint(in, 4);
+				tuple->values[i] = pnstrdup(pq_getmsgbytes(in, len), len);
+				break;
+			default:
+				elog(ERROR, "unknown column status '%c'", status);
+		}
+	}
+}
@@ -0,0 +1,464 @@
+/*-------------------------------------------------------------------------
+ *
+ * logicalrep_sync.c
+ *		  initial copy of the published tables
+ *
+ * When a subscription starts, its leader creates the replication slot and
+ * gets a snapshot of the publisher as of the slot's creation.  The tables
+ * published at that point are copied under that snapshot by a set of sync
+ * workers, each taking the next table from a shared list.  A table is
+ * emptied and loaded in one transaction, with the data streamed from the
+ * publisher's COPY TO straight into our COPY FROM, which can itself load
+ * with several parallel workers if logicalrep.copy_parallel_workers is
+ * set.  Once all tables are done, changes are applied from the slot's
+ * consistent point on.
+ *
+ * Copyright (c) 2015, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		  contrib/logicalrep/logicalrep_sync.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "logicalrep.h"
+
+#include "access/heapam.h"
+#include "access/multixact.h"
+#include "access/xact.h"
+#include "catalog/heap.h"
+#include "catalog/index.h"
+#include "commands/copy.h"
+#include "mb/pg_wchar.h"
+#include "miscadmin.h"
+#include "nodes/makefuncs.h"
+#include "pgstat.h"
+#include "port/atomics.h"
+#include "storage/dsm.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/predicate.h"
+#include "storage/shm_toc.h"
+#include "tcop/tcopprot.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/relcache.h"
+#include "utils/resowner.h"
+#include "utils/snapmgr.h"
+
+#define LOGICALREP_SYNC_MAGIC			0x6c727379
+#define LOGICALREP_SYNC_KEY_SHARED		0
+#define LOGICALREP_SYNC_KEY_TABLES		1
+#define LOGICALREP_SYNC_KEY_CONNINFO	2
+
+typedef struct SyncTable
+{
+	NameData	nspname;
+	NameData	relname;
+} SyncTable;
+
+typedef struct SyncShared
+{
+	Oid			dbid;
+	char		snapshot[NAMEDATALEN];
+	uint32		ntables;
+	pg_atomic_uint32 next;		/* next table to copy */
+	pg_atomic_uint32 ndone;		/* tables copied successfully */
+} SyncShared;
+
+/* Source of the COPY in progress */
+static PGconn *copy_conn = NULL;
+static StringInfo copybuf = NULL;
+static bool copy_eof = false;
+
+static void sync_begin_remote(PGconn *conn, const char *snapshot);
+static void sync_table(PGconn *conn, const char *nspname,
+		   const char *relname);
+static void sync_truncate(Relation rel);
+static int	sync_read_data(void *outbuf, int minread, int maxread);
+
+/*
+ * Copy the tables of the given publications (a text[] literal) as of an
+ * exported snapshot, with up to nworkers sync workers.  Called by the
+ * leader; returns when all tables have been copied.
+ */
+void
+logicalrep_sync_tables(const char *conninfo, const char *snapshot,
+					   const char *publications, int nworkers)
+{
+	PGconn	   *conn;
+	PGresult   *res;
+	int			ntables;
+	shm_toc_estimator e;
+	Size		segsize;
+	dsm_segment *seg;
+	shm_toc    *toc;
+	SyncShared *shared;
+	SyncTable  *tables;
+	char	   *sharedconninfo;
+	BackgroundWorkerHandle **handles;
+	int			i;
+
+	conn = logicalrep_connect(conninfo, false, "logicalrep sync");
+	sync_begin_remote(conn, snapshot);
+	res = logicalrep_exec(conn,
+						  "SELECT nspname, relname "
+			  "FROM logicalrep.publication_tables($1::pg_catalog.text[])",
+						  1, &publications);
+	if (PQresultStatus(res) != PGRES_TUPLES_OK)
+		ereport(ERROR,
+				(errcode(ERRCODE_CONNECTION_FAILURE),
+				 errmsg("could not fetch the published tables: %s",
+						PQresultErrorMessage(res))));
+	ntables = PQntuples(res);
+
+	if (ntables == 0)
+	{
+		PQclear(res);
+		PQfinish(conn);
+		return;
+	}
+
+	shm_toc_initialize_estimator(&e);
+	shm_toc_estimate_chunk(&e, sizeof(SyncShared));
+	shm_toc_estimate_chunk(&e, ntables * sizeof(SyncTable));
+	shm_toc_estimate_chunk(&e, strlen(conninfo) + 1);
+	shm_toc_estimate_keys(&e, 3);
+	segsize = shm_toc_estimate(&e);
+
+	if (CurrentResourceOwner == NULL)
+		CurrentResourceOwner = ResourceOwnerCreate(NULL, "logicalrep leader");
+	seg = dsm_create(segsize, 0);
+	toc = shm_toc_create(LOGICALREP_SYNC_MAGIC, dsm_segment_address(seg),
+						 segsize);
+
+	shared = shm_toc_allocate(toc, sizeof(SyncShared));
+	shared->dbid = MyDatabaseId;
+	strlcpy(shared->snapshot, snapshot, NAMEDATALEN);
+	shared->ntables = ntables;
+	pg_atomic_init_u32(&shared->next, 0);
+	pg_atomic_init_u32(&shared->ndone, 0);
+	shm_toc_insert(toc, LOGICALREP_SYNC_KEY_SHARED, shared);
+
+	tables = shm_toc_allocate(toc, ntables * sizeof(SyncTable));
+	for (i = 0; i < ntables; i++)
+	{
+		namestrcpy(&tables[i].nspname, PQgetvalue(res, i, 0));
+		namestrcpy(&tables[i].relname, PQgetvalue(res, i, 1));
+	}
+	shm_toc_insert(toc, LOGICALREP_SYNC_KEY_TABLES, tables);
+
+	sharedconninfo = shm_toc_allocate(toc, strlen(conninfo) + 1);
+	strcpy(sharedconninfo, conninfo);
+	shm_toc_insert(toc, LOGICALREP_SYNC_KEY_CONNINFO, sharedconninfo);
+
+	PQclear(res);
+	res = logicalrep_exec(conn, "COMMIT", 0, NULL);
+	PQclear(res);
+	PQfinish(conn);
+
+	/* the leader's replication connection keeps the snapshot alive */
+	nworkers = Min(nworkers, ntables);
+	handles = palloc(nworkers * sizeof(BackgroundWorkerHandle *));
+	for (i = 0; i < nworkers; i++)
+		handles[i] = logicalrep_start_child(psprintf("logicalrep sync %d", i),
+											"logicalrep_sync_main",
+							   UInt32GetDatum(dsm_segment_handle(seg)));
+
+	for (i = 0; i < nworkers; i++)
+	{
+		if (WaitForBackgroundWorkerShutdown(handles[i]) == BGWH_POSTMASTER_DIED)
+			proc_exit(1);
+	}
+
+	if (pg_atomic_read_u32(&shared->ndone) != ntables)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("initial copy of the published tables failed")));
+
+	dsm_detach(seg);
+}
+
+/*
+ * Main of a sync worker.
+ */
+void
+logicalrep_sync_main(Datum main_arg)
+{
+	dsm_segment *seg;
+	shm_toc    *toc;
+	SyncShared *shared;
+	SyncTable  *tables;
+	char	   *conninfo;
+	PGconn	   *conn;
+	PGresult   *res;
+	uint32		i;
+
+	pqsignal(SIGTERM, die);
+	BackgroundWorkerUnblockSignals();
+
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, "logicalrep sync");
+	seg = dsm_attach(DatumGetUInt32(main_arg));
+	if (seg == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("could not map dynamic shared memory segment")));
+	dsm_pin_mapping(seg);
+	toc = shm_toc_attach(LOGICALREP_SYNC_MAGIC, dsm_segment_address(seg));
+	if (toc == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("bad magic number in dynamic shared memory segment")));
+	shared = shm_toc_lookup(toc, LOGICALREP_SYNC_KEY_SHARED);
+	tables = shm_toc_lookup(toc, LOGICALREP_SYNC_KEY_TABLES);
+	conninfo = shm_toc_lookup(toc, LOGICALREP_SYNC_KEY_CONNINFO);
+
+	BackgroundWorkerInitializeConnectionByOid(shared->dbid, InvalidOid);
+
+	/* don't fire triggers and rules, nor check foreign keys */
+	SetConfigOption("session_replication_role", "replica",
+					PGC_SUSET, PGC_S_OVERRIDE);
+
+	conn = logicalrep_connect(conninfo, false, "logicalrep sync");
+	sync_begin_remote(conn, shared->snapshot);
+
+	copybuf = MemoryContextAlloc(TopMemoryContext, sizeof(StringInfoData));
+	initStringInfo(copybuf);
+
+	while ((i = pg_atomic_fetch_add_u32(&shared->next, 1)) < shared->ntables)
+	{
+		sync_table(conn, NameStr(tables[i].nspname),
+				   NameStr(tables[i].relname));
+		pg_atomic_fetch_add_u32(&shared->ndone, 1);
+	}
+
+	res = logicalrep_exec(conn, "COMMIT", 0, NULL);
+	PQclear(res);
+	PQfinish(conn);
+
+	proc_exit(0);
+}
+
+/*
+ * Start a transaction on the publisher that sees the data as of the
+ * snapshot the slot was created with.
+ */
+static void
+sync_begin_remote(PGconn *conn, const char *snapshot)
+{
+	PGresult   *res;
+
+	res = logicalrep_exec(conn,
+						  psprintf("BEGIN ISOLATION LEVEL REPEATABLE READ; "
+								   "SET TRANSACTION SNAPSHOT %s",
+								   quote_literal_cstr(snapshot)),
+						  0, NULL);
+	if (PQresultStatus(res) != PGRES_COMMAND_OK)
+		ereport(ERROR,
+				(errcode(ERRCODE_CONNECTION_FAILURE),
+				 errmsg("could not import snapshot \"%s\" on the publisher: %s",
+						snapshot, PQresultErrorMessage(res))));
+	PQclear(res);
+}
+
+/*
+ * Replace the contents of a local table with those of the remote one.
+ */
+static void
+sync_table(PGconn *conn, const char *nspname, const char *relname)
+{
+	char	   *qualname = quote_qualified_identifier(nspname, relname);
+	List	   *attnamelist = NIL;
+	List	   *options;
+	StringInfoData cols;
+	PGresult   *res;
+	Relation	rel;
+	CopyState	cstate;
+	int			i;
+
+	pgstat_report_activity(STATE_RUNNING,
+						   psprintf("copying table %s", qualname));
+
+	res = logicalrep_exec(conn,
+						  "SELECT a.attname FROM pg_catalog.pg_attribute a "
+						  "WHERE a.attrelid = $1::pg_catalog.regclass "
+						  "AND a.attnum > 0 AND NOT a.attisdropped "
+						  "ORDER BY a.attnum",
+						  1, (const char *const *) &qualname);
+	if (PQresultStatus(res) != PGRES_TUPLES_OK)
+		ereport(ERROR,
+				(errcode(ERRCODE_CONNECTION_FAILURE),
+				 errmsg("could not fetch the columns of table %s: %s",
+						qualname, PQresultErrorMessage(res))));
+
+	initStringInfo(&cols);
+	for (i = 0; i < PQntuples(res); i++)
+	{
+		char	   *attname = pstrdup(PQgetvalue(res, i, 0));
+
+		attnamelist = lappend(attnamelist, makeString(attname));
+		appendStringInfo(&cols, "%s%s", i > 0 ? ", " : "",
+						 quote_identifier(attname));
+	}
+	PQclear(res);
+
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	rel = heap_openrv(makeRangeVar(pstrdup(nspname), pstrdup(relname), -1),
+					  AccessExclusiveLock);
+	if (rel->rd_rel->relkind != RELKIND_RELATION)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("logical replication target relation \"%s.%s\" is not a table",
+						nspname, relname)));
+
+	sync_truncate(rel);
+
+	res = logicalrep_exec(conn,
+						  psprintf("COPY %s (%s) TO STDOUT", qualname,
+								   cols.data),
+						  0, NULL);
+	if (PQresultStatus(res) != PGRES_COPY_OUT)
+		ereport(ERROR,
+				(errcode(ERRCODE_CONNECTION_FAILURE),
+				 errmsg("could not start copying table %s: %s",
+						qualname, PQresultErrorMessage(res))));
+	PQclear(res);
+
+	copy_conn = conn;
+	copy_eof = false;
+	resetStringInfo(copybuf);
+
+	options = list_make1(makeDefElem("encoding",
+							(Node *) makeString((char *) GetDatabaseEncodingName())));
+	if (logicalrep_copy_parallel_workers > 0)
+		options = lappend(options,
+						  makeDefElem("parallel",
+							  (Node *) makeInteger(logicalrep_copy_parallel_workers)));
+
+	cstate = BeginCopyFromCallback(rel, sync_read_data, attnamelist, options);
+	(void) CopyFrom(cstate);
+	EndCopyFrom(cstate);
+
+	/* the COPY ends with a CommandComplete */
+	while ((res = PQgetResult(conn)) != NULL)
+	{
+		if (PQresultStatus(res) != PGRES_COMMAND_OK)
+			ereport(ERROR,
+					(errcode(ERRCODE_CONNECTION_FAILURE),
+					 errmsg("could not copy table %s: %s",
+							qualname, PQresultErrorMessage(res))));
+		PQclear(res);
+	}
+	copy_conn = NULL;
+
+	heap_close(rel, NoLock);
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+
+	pgstat_report_stat(false);
+	pgstat_report_activity(STATE_IDLE, NULL);
+}
+
+/*
+ * Empty a table, the way TRUNCATE does.
+ */
+static void
+sync_truncate(Relation rel)
+{
+	Oid			toastrelid = rel->rd_rel->reltoastrelid;
+	MultiXactId minmulti = GetOldestMultiXactId();
+
+	CheckTableForSerializableConflictIn(rel);
+
+	RelationSetNewRelfilenode(rel, rel->rd_rel->relpersistence,
+							  RecentXmin, minmulti);
+	if (rel->rd_rel->relpersistence == RELPERSISTENCE_UNLOGGED)
+		heap_create_init_fork(rel);
+
+	if (OidIsValid(toastrelid))
+	{
+		Relation	toastrel = relation_open(toastrelid, AccessExclusiveLock);
+
+		RelationSetNewRelfilenode(toastrel, toastrel->rd_rel->relpersistence,
+								  RecentXmin, minmulti);
+		if (toastrel->rd_rel->relpersistence == RELPERSISTENCE_UNLOGGED)
+			heap_create_init_fork(toastrel);
+		heap_close(toastrel, NoLock);
+	}
+
+	reindex_relation(RelationGetRelid(rel), REINDEX_REL_PROCESS_TOAST, 0);
+}
+
+/*
+ * COPY FROM data source, reading the publisher's COPY TO output.
+ */
+static int
+sync_read_data(void *outbuf, int minread, int maxread)
+{
+	int			bytesread = 0;
+
+	while (bytesread < minread)
+	{
+		char	   *buf;
+		int			len;
+
+		if (copybuf->cursor < copybuf->len)
+		{
+			int			avail = Min(copybuf->len - copybuf->cursor,
+									maxread - bytesread);
+
+			memcpy((char *) outbuf + bytesread,
+				   copybuf->data + copybuf->cursor, avail);
+			copybuf->cursor += avail;
+			bytesread += avail;
+			continue;
+		}
+
+		if (copy_eof)
+			break;
+
+		len = PQgetCopyData(copy_conn, &buf, 1);
+		if (len > 0)
+		{
+			resetStringInfo(copybuf);
+			appendBinaryStringInfo(copybuf, buf, len);
+			PQfreemem(buf);
+		}
+		else if (len == 0)
+		{
+			int			rc;
+
+			rc = WaitLatchOrSocket(MyLatch,
+								   WL_LATCH_SET | WL_SOCKET_READABLE |
+								   WL_POSTMASTER_DEATH,
+								   PQsocket(copy_conn), 0);
+			ResetLatch(MyLatch);
+
+			if (rc & WL_POSTMASTER_DEATH)
+				proc_exit(1);
+
+			CHECK_FOR_INTERRUPTS();
+
+			if (PQconsumeInput(copy_conn) == 0)
+				ereport(ERROR,
+						(errcode(ERRCODE_CONNECTION_FAILURE),
+						 errmsg("could not receive data from the publisher: %s",
+								PQerrorMessage(copy_conn))));
+		}
+		else if (len == -1)
+			copy_eof = true;
+		else
+			ereport(ERROR,
+					(errcode(ERRCODE_CONNECTION_FAILURE),
+					 errmsg("could not receive data from the publisher: %s",
+							PQerrorMessage(copy_conn))));
+	}
+
+	return bytesread;
+}
@@ -0,0 +1,30 @@
+CREATE EXTENSION logicalrep;
+
+CREATE TABLE pub_tbl (id int PRIMARY KEY, val text);
+CREATE TABLE other_tbl (id int PRIMARY KEY);
+
+SELECT logicalrep.create_publication('pub');
+SELECT logicalrep.publication_add_table('pub', 'pub_tbl');
+SELECT logicalrep.publication_add_table('pub', 'logicalrep.publication');
+SELECT * FROM logicalrep.publication_tables('{pub}');
+
+SELECT 'init' FROM pg_create_logical_replication_slot('regression_slot', 'logicalrep');
+
+INSERT INTO pub_tbl VALUES (1, 'one'), (2, 'two');
+UPDATE pub_tbl SET val = 'uno' WHERE id = 1;
+UPDATE pub_tbl SET id = 3 WHERE id = 2;
+DELETE FROM pub_tbl WHERE id = 1;
+INSERT INTO other_tbl VALUES (1);
+
+-- the protocol version and publications must be given
+SELECT count(*) FROM pg_logical_slot_peek_binary_changes('regression_slot', NULL, NULL);
+SELECT count(*) FROM pg_logical_slot_peek_binary_changes('regression_slot', NULL, NULL, 'proto_version', '2', 'publication_names', 'pub');
+
+-- a message per row, and BEGIN, COMMIT and the relation in each transaction
+SELECT chr(get_byte(data, 0)) AS message, count(*)
+FROM pg_logical_slot_get_binary_changes('regression_slot', NULL, NULL, 'proto_version', '1', 'publication_names', 'pub')
+GROUP BY 1 ORDER BY 1;
+
+SELECT pg_drop_replication_slot('regression_slot');
+DROP TABLE pub_tbl, other_tbl;
+DROP EXTENSION logicalrep;
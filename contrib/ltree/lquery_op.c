@@ -299,6 +299,46 @@ checkCond(lquery_level *curq, int query_numlevel, ltree_level *curt, int tree_nu
 	return true;
 }
 
+/*
+ * Fast path for queries without NOT.  The leading levels that aren't '*'
+ * each have to match just the next level of the tree, with no backtracking,
+ * and a single trailing '*' only bounds the number of levels left, so the
+ * common 'a.b' and 'a.b.*' patterns can be decided by a simple loop.
+ *
+ * Returns whether the tree matches, or -1 if there is more to the query,
+ * which is then left to checkCond: *curq, *qlen, *curt and *tlen are
+ * advanced past the levels matched already.
+ */
+static int
+checkPrefixCond(lquery_level **curq, int *qlen, ltree_level **curt, int *tlen)
+{
+	lquery_level *q = *curq;
+	ltree_level *t = *curt;
+	int			nq = *qlen,
+				nt = *tlen;
+
+	while (nq > 0 && q->numvar)
+	{
+		if (nt == 0 || !checkLevel(q, t))
+			return 0;
+		q = LQL_NEXT(q);
+		nq--;
+		t = LEVEL_NEXT(t);
+		nt--;
+	}
+
+	if (nq == 0)
+		return (nt == 0);
+	if (nq == 1)
+		return (nt >= q->low && nt <= q->high);
+
+	*curq = q;
+	*qlen = nq;
+	*curt = t;
+	*tlen = nt;
+	return -1;
+}
+
 Datum
 ltq_regex(PG_FUNCTION_ARGS)
 {
@@ -317,8 +357,17 @@ ltq_regex(PG_FUNCTION_ARGS)
 	}
 	else
 	{
-		res = checkCond(LQUERY_FIRST(query), query->numlevel,
-						LTREE_FIRST(tree), tree->numlevel, NULL);
+		lquery_level *curq = LQUERY_FIRST(query);
+		int			qlen = query->numlevel;
+		ltree_level *curt = LTREE_FIRST(tree);
+		int			tlen = tree->numlevel;
+		int			prefixres;
+
+		prefixres = checkPrefixCond(&curq, &qlen, &curt, &tlen);
+		if (prefixres >= 0)
+			res = (prefixres != 0);
+		else
+			res = checkCond(curq, qlen, curt, tlen, NULL);
 	}
 
 	PG_FREE_IF_COPY(tree, 0);
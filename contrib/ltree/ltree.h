@@ -174,8 +174,21 @@ int			ltree_strncasecmp(const char *a, const char *b, size_t s);
 
 /* GiST support for ltree */
 
+/*
+ * Length of the signatures of gist_ltree_ops, in int32s.  Longer signatures
+ * make the index bigger, but give fewer false matches on large label sets.
+ * It can be set at build time, e.g. with PG_CPPFLAGS="-DLOWER_NODE
+ * -DLTREE_SIGLENINT=8"; existing indexes must then be rebuilt.
+ */
+#ifndef LTREE_SIGLENINT
+#define LTREE_SIGLENINT 2
+#endif
+#if LTREE_SIGLENINT < 1 || LTREE_SIGLENINT > 255
+#error LTREE_SIGLENINT must be between 1 and 255
+#endif
+
 #define BITBYTE 8
-#define SIGLENINT  2
+#define SIGLENINT  LTREE_SIGLENINT
 #define SIGLEN	( sizeof(int32)*SIGLENINT )
 #define SIGLENBIT (SIGLEN*BITBYTE)
 typedef unsigned char BITVEC[SIGLEN];
@@ -202,6 +215,12 @@ typedef unsigned char *BITVECP;
  *				 (len)(flag)(sign)(left_ltree)(right_ltree)
  *		ALLTRUE: (len)(flag)(left_ltree)(right_ltree)
  *
+ * In a non-leaf key, bits 8-15 of flag hold the SIGLENINT the key was made
+ * with (0 in keys of older versions, which always used 2), so that a key
+ * with a different signature length is caught rather than misread.  On
+ * disk, with LTG_RPREFIX set, the right_ltree lacks the leading levels it
+ * has in common with the left_ltree, whose number is in bits 16-31.  That
+ * is undone by ltree_decompress, so other code never sees it.
  */
 
 typedef struct
@@ -214,6 +233,13 @@ typedef struct
 #define LTG_ONENODE 0x01
 #define LTG_ALLTRUE 0x02
 #define LTG_NORIGHT 0x04
+#define LTG_RPREFIX 0x08
+
+#define LTG_SIGLENSHIFT		8
+#define LTG_PREFIXSHIFT		16
+#define LTG_SIGLENFLAG		(SIGLENINT << LTG_SIGLENSHIFT)
+#define LTG_GETSIGLENINT(x) ( ( ((ltree_gist*)(x))->flag >> LTG_SIGLENSHIFT ) & 0xff )
+#define LTG_GETPREFIX(x)	( ((ltree_gist*)(x))->flag >> LTG_PREFIXSHIFT )
 
 #define LTG_HDRSIZE MAXALIGN(VARHDRSZ + sizeof(uint32))
 #define LTG_SIGN(x) ( (BITVECP)( ((char*)(x))+LTG_HDRSIZE ) )
@@ -231,7 +257,12 @@ typedef struct
 
 /* GiST support for ltree[] */
 
-#define ASIGLENINT	(7)
+/* as LTREE_SIGLENINT, for gist__ltree_ops */
+#ifndef LTREE_ASIGLENINT
+#define LTREE_ASIGLENINT 7
+#endif
+
+#define ASIGLENINT	(LTREE_ASIGLENINT)
 #define ASIGLEN		(sizeof(int32)*ASIGLENINT)
 #define ASIGLENBIT (ASIGLEN*BITBYTE)
 typedef unsigned char ABITVEC[ASIGLEN];
@@ -44,6 +44,99 @@ PG_FUNCTION_INFO_V1(ltree_consistent);
 #define ISEQ(a,b)	( (a)->numlevel == (b)->numlevel && ltree_compare(a,b)==0 )
 #define GETENTRY(vec,pos) ((ltree_gist *) DatumGetPointer((vec)->vector[(pos)].key))
 
+/*
+ * Size of the levels of an ltree from level "from" on.
+ */
+static int
+levels_size(ltree *t, ltree_level *from)
+{
+	return VARSIZE(t) - (((char *) from) - ((char *) t));
+}
+
+/*
+ * Store the right bound of a non-leaf key without the leading levels it
+ * shares with the left bound.  The bounds of a subtree are often long paths
+ * that only differ near the end, so this makes the upper levels of the
+ * index a lot smaller.  Returns NULL if nothing is saved.
+ */
+static ltree_gist *
+compress_right_node(ltree_gist *key)
+{
+	ltree	   *left = LTG_LNODE(key);
+	ltree	   *right = LTG_RNODE(key);
+	ltree_level *lcur = LTREE_FIRST(left);
+	ltree_level *rcur = LTREE_FIRST(right);
+	int			nprefix = 0;
+	int			suffixsize;
+	int32		size;
+	ltree_gist *result;
+	ltree	   *suffix;
+
+	while (nprefix < left->numlevel && nprefix < right->numlevel &&
+		   lcur->len == rcur->len &&
+		   memcmp(lcur->name, rcur->name, lcur->len) == 0)
+	{
+		nprefix++;
+		lcur = LEVEL_NEXT(lcur);
+		rcur = LEVEL_NEXT(rcur);
+	}
+
+	if (nprefix == 0)
+		return NULL;
+
+	suffixsize = levels_size(right, rcur);
+	size = ((char *) right) - ((char *) key) + LTREE_HDRSIZE + suffixsize;
+	result = (ltree_gist *) palloc0(size);
+	memcpy((void *) result, (void *) key, ((char *) right) - ((char *) key));
+	SET_VARSIZE(result, size);
+	result->flag |= LTG_RPREFIX | ((uint32) nprefix << LTG_PREFIXSHIFT);
+
+	suffix = LTG_RNODE(result);
+	SET_VARSIZE(suffix, LTREE_HDRSIZE + suffixsize);
+	suffix->numlevel = right->numlevel - nprefix;
+	memcpy((void *) LTREE_FIRST(suffix), (void *) rcur, suffixsize);
+
+	return result;
+}
+
+/*
+ * Undo compress_right_node.
+ */
+static ltree_gist *
+decompress_right_node(ltree_gist *key)
+{
+	ltree	   *left = LTG_LNODE(key);
+	ltree	   *suffix = LTG_RNODE(key);
+	int			nprefix = LTG_GETPREFIX(key);
+	ltree_level *lcur = LTREE_FIRST(left);
+	int			prefixsize;
+	int			suffixsize = levels_size(suffix, LTREE_FIRST(suffix));
+	int32		size;
+	ltree_gist *result;
+	ltree	   *right;
+	int			i;
+
+	for (i = 0; i < nprefix; i++)
+		lcur = LEVEL_NEXT(lcur);
+	prefixsize = ((char *) lcur) - ((char *) LTREE_FIRST(left));
+
+	size = ((char *) suffix) - ((char *) key) +
+		LTREE_HDRSIZE + prefixsize + suffixsize;
+	result = (ltree_gist *) palloc0(size);
+	memcpy((void *) result, (void *) key, ((char *) suffix) - ((char *) key));
+	SET_VARSIZE(result, size);
+	result->flag &= ~(LTG_RPREFIX | ((uint32) 0xffff << LTG_PREFIXSHIFT));
+
+	right = LTG_RNODE(result);
+	SET_VARSIZE(right, LTREE_HDRSIZE + prefixsize + suffixsize);
+	right->numlevel = nprefix + suffix->numlevel;
+	memcpy((void *) LTREE_FIRST(right), (void *) LTREE_FIRST(left), prefixsize);
+	memcpy(((char *) LTREE_FIRST(right)) + prefixsize,
+		   (void *) LTREE_FIRST(suffix), suffixsize);
+
+	return result;
+}
+
 Datum
 ltree_compress(PG_FUNCTION_ARGS)
 {
@@ -66,6 +159,23 @@ ltree_compress(PG_FUNCTION_ARGS)
 					  entry->rel, entry->page,
 					  entry->offset, FALSE);
 	}
+	else
+	{
+		ltree_gist *key = (ltree_gist *) DatumGetPointer(entry->key);
+
+		if (!LTG_ISONENODE(key) && !LTG_ISNORIGHT(key) &&
+			!(key->flag & LTG_RPREFIX))
+		{
+			key = compress_right_node(key);
+			if (key)
+			{
+				retval = (GISTENTRY *) palloc(sizeof(GISTENTRY));
+				gistentryinit(*retval, PointerGetDatum(key),
+							  entry->rel, entry->page,
+							  entry->offset, FALSE);
+			}
+		}
+	}
 	PG_RETURN_POINTER(retval);
 }
 
@@ -75,6 +185,23 @@ ltree_decompress(PG_FUNCTION_ARGS)
 	GISTENTRY  *entry = (GISTENTRY *) PG_GETARG_POINTER(0);
 	ltree_gist *key = (ltree_gist *) DatumGetPointer(PG_DETOAST_DATUM(entry->key));
 
+	if (!LTG_ISONENODE(key))
+	{
+		int			siglenint = LTG_GETSIGLENINT(key);
+
+		if (siglenint == 0)
+			siglenint = 2;
+		if (!LTG_ISALLTRUE(key) && siglenint != SIGLENINT)
+			ereport(ERROR,
+					(errcode(ERRCODE_INDEX_CORRUPTED),
+					 errmsg("index key has signature length %d, but ltree was built with %d",
+							siglenint, SIGLENINT),
+					 errhint("REINDEX the index.")));
+
+		if (key->flag & LTG_RPREFIX)
+			key = decompress_right_node(key);
+	}
+
 	if (PointerGetDatum(key) != entry->key)
 	{
 		GISTENTRY  *retval = (GISTENTRY *) palloc(sizeof(GISTENTRY));
@@ -215,7 +342,7 @@ ltree_union(PG_FUNCTION_ARGS)
 
 	result = (ltree_gist *) palloc(*size);
 	SET_VARSIZE(result, *size);
-	result->flag = 0;
+	result->flag = LTG_SIGLENFLAG;
 
 	if (isalltrue)
 		result->flag |= LTG_ALLTRUE;
@@ -388,7 +515,7 @@ ltree_picksplit(PG_FUNCTION_ARGS)
 	size = LTG_HDRSIZE + ((lisat) ? 0 : SIGLEN) + VARSIZE(lu_l) + ((isleqr) ? 0 : VARSIZE(lu_r));
 	lu = (ltree_gist *) palloc(size);
 	SET_VARSIZE(lu, size);
-	lu->flag = 0;
+	lu->flag = LTG_SIGLENFLAG;
 	if (lisat)
 		lu->flag |= LTG_ALLTRUE;
 	else
@@ -405,7 +532,7 @@ ltree_picksplit(PG_FUNCTION_ARGS)
 	size = LTG_HDRSIZE + ((risat) ? 0 : SIGLEN) + VARSIZE(ru_l) + ((isleqr) ? 0 : VARSIZE(ru_r));
 	ru = (ltree_gist *) palloc(size);
 	SET_VARSIZE(ru, size);
-	ru->flag = 0;
+	ru->flag = LTG_SIGLENFLAG;
 	if (risat)
 		ru->flag |= LTG_ALLTRUE;
 	else
@@ -113,6 +113,16 @@ SELECT 'a.b.c.d.e'::ltree ~ 'a.*{2,3}.e';
 SELECT 'a.b.c.d.e'::ltree ~ 'a.*{2,3}';
 SELECT 'a.b.c.d.e'::ltree ~ 'a.*{2,4}';
 SELECT 'a.b.c.d.e'::ltree ~ 'a.*{2,5}';
+SELECT 'a.b.c.d.e'::ltree ~ 'a.b.*';
+SELECT 'a.b.c.d.e'::ltree ~ 'a.c.*';
+SELECT 'a.b.c.d.e'::ltree ~ 'a.b.c.*{3}';
+SELECT 'a.b.c.d.e'::ltree ~ 'a.b.*{4,}';
+SELECT 'a.b.c.d.e'::ltree ~ 'a.b.c.d.e.*';
+SELECT 'a.b.c.d.e'::ltree ~ 'a.b.c.d.e.f.*';
+SELECT 'a.b.c.d.e'::ltree ~ 'a|x.b.c.d.e';
+SELECT 'a.b.c.d.e'::ltree ~ 'a.b.*.e';
+SELECT 'a.b'::ltree ~ 'a.b.*';
+SELECT 'a'::ltree ~ 'a.b.*';
 SELECT 'a.b.c.d.e'::ltree ~ '*{2,3}.e';
 SELECT 'a.b.c.d.e'::ltree ~ '*{2,4}.e';
 SELECT 'a.b.c.d.e'::ltree ~ '*{2,5}.e';
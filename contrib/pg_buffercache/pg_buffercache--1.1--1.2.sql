@@ -0,0 +1,19 @@
+/* contrib/pg_buffercache/pg_buffercache--1.1--1.2.sql */
+
+-- complain if script is sourced in psql, rather than via ALTER EXTENSION
+\echo Use "ALTER EXTENSION pg_buffercache UPDATE TO '1.2'" to load this file. \quit
+
+-- Register the summary function.
+CREATE FUNCTION pg_buffercache_summary(
+    OUT relfilenode oid,
+    OUT reltablespace oid,
+    OUT reldatabase oid,
+    OUT relforknumber int2,
+    OUT buffers int8,
+    OUT dirty int8,
+    OUT usagecount_total int8)
+RETURNS SETOF RECORD
+AS 'MODULE_PATHNAME', 'pg_buffercache_summary'
+LANGUAGE C;
+
+REVOKE ALL ON FUNCTION pg_buffercache_summary() FROM PUBLIC;
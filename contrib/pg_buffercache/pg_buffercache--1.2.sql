@@ -1,4 +1,4 @@
-/* contrib/pg_buffercache/pg_buffercache--1.1.sql */
+/* contrib/pg_buffercache/pg_buffercache--1.2.sql */
 
 -- complain if script is sourced in psql, rather than via CREATE EXTENSION
 \echo Use "CREATE EXTENSION pg_buffercache" to load this file. \quit
@@ -16,6 +16,20 @@ CREATE VIEW pg_buffercache AS
 	 relforknumber int2, relblocknumber int8, isdirty bool, usagecount int2,
 	 pinning_backends int4);
 
+-- Register the summary function.
+CREATE FUNCTION pg_buffercache_summary(
+    OUT relfilenode oid,
+    OUT reltablespace oid,
+    OUT reldatabase oid,
+    OUT relforknumber int2,
+    OUT buffers int8,
+    OUT dirty int8,
+    OUT usagecount_total int8)
+RETURNS SETOF RECORD
+AS 'MODULE_PATHNAME', 'pg_buffercache_summary'
+LANGUAGE C;
+
 -- Don't want these to be available to public.
 REVOKE ALL ON FUNCTION pg_buffercache_pages() FROM PUBLIC;
 REVOKE ALL ON pg_buffercache FROM PUBLIC;
+REVOKE ALL ON FUNCTION pg_buffercache_summary() FROM PUBLIC;
@@ -11,12 +11,19 @@
 #include "access/htup_details.h"
 #include "catalog/pg_type.h"
 #include "funcapi.h"
+#include "miscadmin.h"
 #include "storage/buf_internals.h"
 #include "storage/bufmgr.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
 
 
 #define NUM_BUFFERCACHE_PAGES_MIN_ELEM	8
 #define NUM_BUFFERCACHE_PAGES_ELEM	9
+#define NUM_BUFFERCACHE_SUMMARY_ELEM	7
+
+/* How many buffers to scan between checks for interrupts */
+#define BUFFERCACHE_SCAN_BATCH	1024
 
 PG_MODULE_MAGIC;
 
@@ -53,12 +60,30 @@ typedef struct
 	BufferCachePagesRec *record;
 } BufferCachePagesContext;
 
+/*
+ * Hash table key and entry for pg_buffercache_summary.
+ */
+typedef struct
+{
+	RelFileNode rnode;
+	ForkNumber	forknum;
+} BufferCacheSummaryKey;
+
+typedef struct
+{
+	BufferCacheSummaryKey key;	/* hash key, must be first */
+	int64		buffers;
+	int64		dirty;
+	int64		usagecount_total;
+} BufferCacheSummaryEntry;
+
 
 /*
  * Function returning data from the shared buffer cache - buffer number,
  * relation node/tablespace/database/blocknum and dirty indicator.
  */
 PG_FUNCTION_INFO_V1(pg_buffercache_pages);
+PG_FUNCTION_INFO_V1(pg_buffercache_summary);
 
 Datum
 pg_buffercache_pages(PG_FUNCTION_ARGS)
@@ -123,8 +148,13 @@ pg_buffercache_pages(PG_FUNCTION_ARGS)
 
 		fctx->tupdesc = BlessTupleDesc(tupledesc);
 
-		/* Allocate NBuffers worth of BufferCachePagesRec records. */
-		fctx->record = (BufferCachePagesRec *) palloc(sizeof(BufferCachePagesRec) * NBuffers);
+		/*
+		 * Allocate NBuffers worth of BufferCachePagesRec records.  With a
+		 * large buffer cache this can exceed MaxAllocSize.
+		 */
+		fctx->record = (BufferCachePagesRec *)
+			MemoryContextAllocHuge(CurrentMemoryContext,
+								   sizeof(BufferCachePagesRec) * NBuffers);
 
 		/* Set max calls and remember the user function context. */
 		funcctx->max_calls = NBuffers;
@@ -133,26 +163,29 @@ pg_buffercache_pages(PG_FUNCTION_ARGS)
 		/* Return to original context when allocating transient memory */
 		MemoryContextSwitchTo(oldcontext);
 
-		/*
-		 * To get a consistent picture of the buffer state, we must lock all
-		 * partitions of the buffer map.  Needless to say, this is horrible
-		 * for concurrency.  Must grab locks in increasing order to avoid
-		 * possible deadlocks.
-		 */
-		for (i = 0; i < NUM_BUFFER_PARTITIONS; i++)
-			LWLockAcquire(BufMappingPartitionLockByIndex(i), LW_SHARED);
-
 		/*
 		 * Scan through all the buffers, saving the relevant fields in the
 		 * fctx->record structure.
+		 *
+		 * We don't lock the partitions of the buffer map, which would stall
+		 * every backend needing to look up or replace a buffer for the whole
+		 * scan, and on a large buffer cache that takes a long time.  Each
+		 * buffer's header is locked while we copy it, so every record is
+		 * self-consistent, but buffers may be evicted or loaded while we
+		 * scan, so the result isn't a consistent snapshot of the whole
+		 * cache: a block can even appear twice, or not at all.
 		 */
 		for (i = 0; i < NBuffers; i++)
 		{
 			volatile BufferDesc *bufHdr;
+			uint32		buf_state;
+
+			if (i % BUFFERCACHE_SCAN_BATCH == 0)
+				CHECK_FOR_INTERRUPTS();
 
 			bufHdr = GetBufferDescriptor(i);
 			/* Lock each buffer header before inspecting. */
-			LockBufHdr(bufHdr);
+			buf_state = LockBufHdr(bufHdr);
 
 			fctx->record[i].bufferid = BufferDescriptorGetBuffer(bufHdr);
 			fctx->record[i].relfilenode = bufHdr->tag.rnode.relNode;
@@ -160,32 +193,22 @@ pg_buffercache_pages(PG_FUNCTION_ARGS)
 			fctx->record[i].reldatabase = bufHdr->tag.rnode.dbNode;
 			fctx->record[i].forknum = bufHdr->tag.forkNum;
 			fctx->record[i].blocknum = bufHdr->tag.blockNum;
-			fctx->record[i].usagecount = bufHdr->usage_count;
-			fctx->record[i].pinning_backends = bufHdr->refcount;
+			fctx->record[i].usagecount = BUF_STATE_GET_USAGECOUNT(buf_state);
+			fctx->record[i].pinning_backends = BUF_STATE_GET_REFCOUNT(buf_state);
 
-			if (bufHdr->flags & BM_DIRTY)
+			if (buf_state & BM_DIRTY)
 				fctx->record[i].isdirty = true;
 			else
 				fctx->record[i].isdirty = false;
 
 			/* Note if the buffer is valid, and has storage created */
-			if ((bufHdr->flags & BM_VALID) && (bufHdr->flags & BM_TAG_VALID))
+			if ((buf_state & BM_VALID) && (buf_state & BM_TAG_VALID))
 				fctx->record[i].isvalid = true;
 			else
 				fctx->record[i].isvalid = false;
 
-			UnlockBufHdr(bufHdr);
+			UnlockBufHdr(bufHdr, buf_state);
 		}
-
-		/*
-		 * And release locks.  We do this in reverse order for two reasons:
-		 * (1) Anyone else who needs more than one of the locks will be trying
-		 * to lock them in increasing order; we don't want to release the
-		 * other process until it can get all the locks it needs. (2) This
-		 * avoids O(N^2) behavior inside LWLockRelease.
-		 */
-		for (i = NUM_BUFFER_PARTITIONS; --i >= 0;)
-			LWLockRelease(BufMappingPartitionLockByIndex(i));
 	}
 
 	funcctx = SRF_PERCALL_SETUP();
@@ -249,3 +272,136 @@ pg_buffercache_pages(PG_FUNCTION_ARGS)
 	else
 		SRF_RETURN_DONE(funcctx);
 }
+
+/*
+ * Function returning one row per relation fork present in the shared buffer
+ * cache, with the number of its buffers, how many of them are dirty, and the
+ * sum of their usage counts.
+ *
+ * This is much cheaper than aggregating the output of pg_buffercache_pages,
+ * as it needs memory only for the relations found, rather than for every
+ * buffer, and doesn't form a tuple per buffer.  As there, the buffer map is
+ * not locked, so the counts are not a consistent snapshot.
+ */
+Datum
+pg_buffercache_summary(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	HASHCTL		ctl;
+	HTAB	   *summary;
+	HASH_SEQ_STATUS hash_seq;
+	BufferCacheSummaryEntry *entry;
+	int			i;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	/* Switch into long-lived context to construct returned data structures */
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+	if (tupdesc->natts != NUM_BUFFERCACHE_SUMMARY_ELEM)
+		elog(ERROR, "incorrect number of output arguments");
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(BufferCacheSummaryKey);
+	ctl.entrysize = sizeof(BufferCacheSummaryEntry);
+	ctl.hcxt = CurrentMemoryContext;
+	summary = hash_create("pg_buffercache summary", 1024, &ctl,
+						  HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	/*
+	 * Scan through all the buffers, without locking the buffer map; see
+	 * pg_buffercache_pages.  We copy each buffer's tag and state under its
+	 * header lock, and do the hash table lookup after releasing that.
+	 */
+	for (i = 0; i < NBuffers; i++)
+	{
+		volatile BufferDesc *bufHdr;
+		uint32		buf_state;
+		BufferCacheSummaryKey key;
+		bool		found;
+
+		if (i % BUFFERCACHE_SCAN_BATCH == 0)
+			CHECK_FOR_INTERRUPTS();
+
+		bufHdr = GetBufferDescriptor(i);
+
+		/* Unused buffers can be skipped without taking the lock */
+		if (!(pg_atomic_read_u32(&bufHdr->state) & BM_TAG_VALID))
+			continue;
+
+		/* Zero the key, as it's hashed including any padding */
+		memset(&key, 0, sizeof(key));
+
+		buf_state = LockBufHdr(bufHdr);
+		key.rnode = bufHdr->tag.rnode;
+		key.forknum = bufHdr->tag.forkNum;
+		UnlockBufHdr(bufHdr, buf_state);
+
+		if (!(buf_state & BM_VALID) || !(buf_state & BM_TAG_VALID))
+			continue;
+
+		entry = (BufferCacheSummaryEntry *)
+			hash_search(summary, &key, HASH_ENTER, &found);
+		if (!found)
+		{
+			entry->buffers = 0;
+			entry->dirty = 0;
+			entry->usagecount_total = 0;
+		}
+
+		entry->buffers++;
+		if (buf_state & BM_DIRTY)
+			entry->dirty++;
+		entry->usagecount_total += BUF_STATE_GET_USAGECOUNT(buf_state);
+	}
+
+	hash_seq_init(&hash_seq, summary);
+	while ((entry = hash_seq_search(&hash_seq)) != NULL)
+	{
+		Datum		values[NUM_BUFFERCACHE_SUMMARY_ELEM];
+		bool		nulls[NUM_BUFFERCACHE_SUMMARY_ELEM];
+
+		memset(nulls, 0, sizeof(nulls));
+
+		values[0] = ObjectIdGetDatum(entry->key.rnode.relNode);
+		values[1] = ObjectIdGetDatum(entry->key.rnode.spcNode);
+		values[2] = ObjectIdGetDatum(entry->key.rnode.dbNode);
+		values[3] = Int16GetDatum(entry->key.forknum);
+		values[4] = Int64GetDatum(entry->buffers);
+		values[5] = Int64GetDatum(entry->dirty);
+		values[6] = Int64GetDatum(entry->usagecount_total);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	hash_destroy(summary);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
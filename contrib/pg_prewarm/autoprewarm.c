@@ -0,0 +1,1127 @@
+/*-------------------------------------------------------------------------
+ *
+ * autoprewarm.c
+ *		Periodically dump information about the blocks present in
+ *		shared_buffers, and reload them on server restart.
+ *
+ *		Due to locking considerations, we can't actually begin prewarming
+ *		until the server reaches a consistent state.  We need the catalogs
+ *		to be consistent so that we can figure out which relation to lock,
+ *		and we need to lock the relations so that we don't try to prewarm
+ *		pages from a relation that is in the process of being dropped.
+ *
+ *		While prewarming, autoprewarm will use several background workers,
+ *		each of them connected to one database and loading one range of the
+ *		sorted list of blocks; a database with many blocks is split into
+ *		several ranges so that they can be loaded concurrently.  Prewarming
+ *		happens while the server accepts connections.
+ *
+ *		Copyright (c) 2015, PostgreSQL Global Development Group
+ *
+ *	IDENTIFICATION
+ *		contrib/pg_prewarm/autoprewarm.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include <unistd.h>
+
+#include "access/heapam.h"
+#include "access/xact.h"
+#include "fmgr.h"
+#include "miscadmin.h"
+#include "port/atomics.h"
+#include "postmaster/bgworker.h"
+#include "postmaster/postmaster.h"
+#include "storage/buf_internals.h"
+#include "storage/dsm.h"
+#include "storage/fd.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/lwlock.h"
+#include "storage/procsignal.h"
+#include "storage/shmem.h"
+#include "storage/smgr.h"
+#include "tcop/tcopprot.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/relfilenodemap.h"
+#include "utils/resowner.h"
+#include "utils/timestamp.h"
+
+#define AUTOPREWARM_FILE "autoprewarm.blocks"
+
+/* Don't split a database's blocks into ranges smaller than this */
+#define APW_MIN_RANGE_BLOCKS	4096
+
+/* How many blocks ahead of the one being read to prefetch */
+#define APW_PREFETCH_DISTANCE	32
+
+/* Metadata for each block we dump. */
+typedef struct BlockInfoRecord
+{
+	Oid			database;
+	Oid			tablespace;
+	Oid			filenode;
+	ForkNumber	forknum;
+	BlockNumber blocknum;
+} BlockInfoRecord;
+
+/* A range of the block list, loaded by one per-database worker. */
+typedef struct AutoPrewarmRange
+{
+	Oid			database;		/* database to connect to */
+	int			start_idx;		/* first block of the range */
+	int			stop_idx;		/* one past the last block of the range */
+} AutoPrewarmRange;
+
+/*
+ * Dynamic shared memory segment holding the block list while it's being
+ * loaded.  The ranges follow the struct, and the blocks follow the ranges.
+ */
+typedef struct AutoPrewarmBlockList
+{
+	int			nranges;
+	int			nblocks;
+	pg_atomic_uint64 prewarmed_blocks;	/* blocks loaded by the workers */
+} AutoPrewarmBlockList;
+
+#define APW_RANGES(list) \
+	((AutoPrewarmRange *) ((char *) (list) + \
+						   MAXALIGN(sizeof(AutoPrewarmBlockList))))
+#define APW_BLOCKS(list) \
+	((BlockInfoRecord *) ((char *) APW_RANGES(list) + \
+						  MAXALIGN(sizeof(AutoPrewarmRange) * (list)->nranges)))
+
+/* Shared state information for autoprewarm bgworker. */
+typedef struct AutoPrewarmSharedState
+{
+	LWLock		lock;			/* mutual exclusion */
+	int			tranche_id;
+	pid_t		bgworker_pid;	/* for main bgworker */
+	pid_t		pid_using_dumpfile;		/* for autoprewarm or block dump */
+
+	/* Following item is for communication with per-database workers */
+	dsm_handle	block_info_handle;
+} AutoPrewarmSharedState;
+
+void		_PG_init(void);
+PGDLLEXPORT void autoprewarm_main(Datum main_arg);
+PGDLLEXPORT void autoprewarm_database_main(Datum main_arg);
+
+PG_FUNCTION_INFO_V1(autoprewarm_start_worker);
+PG_FUNCTION_INFO_V1(autoprewarm_dump_now);
+
+static void apw_load_buffers(void);
+static int	apw_dump_now(bool is_bgworker, bool dump_unlogged);
+static void apw_start_master_worker(void);
+static bool apw_start_database_worker(int range_idx,
+						  BackgroundWorkerHandle **handle);
+static void apw_wait_for_workers(BackgroundWorkerHandle **handles,
+					 int *nrunning, int limit);
+static bool apw_init_shmem(void);
+static void apw_detach_shmem(int code, Datum arg);
+static int	apw_compare_blockinfo(const void *p, const void *q);
+static void apw_sigterm_handler(SIGNAL_ARGS);
+static void apw_sighup_handler(SIGNAL_ARGS);
+
+/* Flags set by signal handlers */
+static volatile sig_atomic_t got_sigterm = false;
+static volatile sig_atomic_t got_sighup = false;
+
+/* Pointer to shared-memory state. */
+static AutoPrewarmSharedState *apw_state = NULL;
+static LWLockTranche apw_tranche;
+
+/* GUC variables. */
+static bool autoprewarm = true; /* start worker? */
+static int	autoprewarm_interval;		/* dump interval */
+static int	autoprewarm_workers;		/* max. concurrent loading workers */
+
+/*
+ * Module load callback.
+ */
+void
+_PG_init(void)
+{
+	DefineCustomIntVariable("pg_prewarm.autoprewarm_interval",
+							"Sets the interval between dumps of shared buffers",
+							"If set to zero, time-based dumping is disabled.",
+							&autoprewarm_interval,
+							300,
+							0, INT_MAX / 1000,
+							PGC_SIGHUP,
+							GUC_UNIT_S,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("pg_prewarm.autoprewarm_workers",
+							"Sets the maximum number of workers loading blocks at the same time.",
+							NULL,
+							&autoprewarm_workers,
+							4,
+							1, MAX_BACKENDS,
+							PGC_SIGHUP,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	if (!process_shared_preload_libraries_in_progress)
+		return;
+
+	/* can't define PGC_POSTMASTER variable after startup */
+	DefineCustomBoolVariable("pg_prewarm.autoprewarm",
+							 "Starts the autoprewarm worker.",
+							 NULL,
+							 &autoprewarm,
+							 true,
+							 PGC_POSTMASTER,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	EmitWarningsOnPlaceholders("pg_prewarm");
+
+	RequestAddinShmemSpace(MAXALIGN(sizeof(AutoPrewarmSharedState)));
+
+	/* Register autoprewarm worker, if enabled. */
+	if (autoprewarm)
+		apw_start_master_worker();
+}
+
+/*
+ * Main entry point for the master autoprewarm process.  Per-database workers
+ * have a separate entry point.
+ */
+void
+autoprewarm_main(Datum main_arg)
+{
+	bool		first_time = true;
+	TimestampTz last_dump_time = 0;
+
+	/* Establish signal handlers; once that's done, unblock signals. */
+	pqsignal(SIGTERM, apw_sigterm_handler);
+	pqsignal(SIGHUP, apw_sighup_handler);
+	pqsignal(SIGUSR1, procsignal_sigusr1_handler);
+	BackgroundWorkerUnblockSignals();
+
+	/* We need a resource owner to keep track of our DSM segment */
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, "autoprewarm");
+
+	/* Create (if necessary) and attach to our shared memory area. */
+	if (apw_init_shmem())
+		first_time = false;
+
+	/* Set on-detach hook so that our PID will be cleared on exit. */
+	on_shmem_exit(apw_detach_shmem, 0);
+
+	/*
+	 * Store our PID in the shared memory area --- unless there's already
+	 * another worker running, in which case just exit.
+	 */
+	LWLockAcquire(&apw_state->lock, LW_EXCLUSIVE);
+	if (apw_state->bgworker_pid != InvalidPid)
+	{
+		LWLockRelease(&apw_state->lock);
+		ereport(LOG,
+				(errmsg("autoprewarm worker is already running under PID %d",
+						(int) apw_state->bgworker_pid)));
+		return;
+	}
+	apw_state->bgworker_pid = MyProcPid;
+	LWLockRelease(&apw_state->lock);
+
+	/*
+	 * Preload buffers from the dump file only if we just created the shared
+	 * memory region.  Otherwise, it's either already been done or shouldn't
+	 * be done - e.g. because the old dump file has been overwritten since the
+	 * server was started.
+	 *
+	 * There's not much point in performing a dump immediately after we
+	 * finish preloading buffers.  So, if we do end up preloading buffers,
+	 * reset the last dump time so that the next dump happens after a full
+	 * interval.
+	 */
+	if (first_time)
+	{
+		apw_load_buffers();
+		last_dump_time = GetCurrentTimestamp();
+	}
+
+	/* Periodically dump buffers until terminated. */
+	while (!got_sigterm)
+	{
+		int			rc;
+
+		/* In case of a SIGHUP, just reload the configuration. */
+		if (got_sighup)
+		{
+			got_sighup = false;
+			ProcessConfigFile(PGC_SIGHUP);
+		}
+
+		if (autoprewarm_interval <= 0)
+		{
+			/* We're only dumping at shutdown, so just wait forever. */
+			rc = WaitLatch(MyLatch,
+						   WL_LATCH_SET | WL_POSTMASTER_DEATH,
+						   -1L);
+		}
+		else
+		{
+			long		delay_in_ms = 0;
+			TimestampTz next_dump_time = 0;
+			long		secs = 0;
+			int			usecs = 0;
+
+			/* Compute the next dump time. */
+			next_dump_time =
+				TimestampTzPlusMilliseconds(last_dump_time,
+											autoprewarm_interval * 1000);
+			TimestampDifference(GetCurrentTimestamp(), next_dump_time,
+								&secs, &usecs);
+			delay_in_ms = secs * 1000 + (usecs / 1000);
+
+			/* Perform a dump if it's time. */
+			if (delay_in_ms <= 0)
+			{
+				last_dump_time = GetCurrentTimestamp();
+				apw_dump_now(true, false);
+				continue;
+			}
+
+			/* Sleep until the next dump time. */
+			rc = WaitLatch(MyLatch,
+						   WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+						   delay_in_ms);
+		}
+
+		/* Reset the latch, bail out if postmaster died, otherwise loop. */
+		ResetLatch(MyLatch);
+		if (rc & WL_POSTMASTER_DEATH)
+			proc_exit(1);
+	}
+
+	/*
+	 * Dump one last time.  We assume this is probably the result of a system
+	 * shutdown, although it's possible that we've merely been terminated.
+	 */
+	apw_dump_now(true, true);
+}
+
+/*
+ * Read the dump file and launch per-database workers to load the blocks
+ * listed in it, several at a time.
+ */
+static void
+apw_load_buffers(void)
+{
+	FILE	   *file = NULL;
+	int			num_elements,
+				i;
+	BlockInfoRecord *blkinfo;
+	AutoPrewarmRange *ranges;
+	int			nranges;
+	dsm_segment *seg;
+	AutoPrewarmBlockList *list;
+	Size		segsize;
+	BackgroundWorkerHandle **handles;
+	int			nrunning = 0;
+	int			maxworkers = autoprewarm_workers;
+	int			next_range;
+
+	/*
+	 * Skip the prewarm if the dump file is in use; otherwise, prevent any
+	 * other process from writing it while we're using it.
+	 */
+	LWLockAcquire(&apw_state->lock, LW_EXCLUSIVE);
+	if (apw_state->pid_using_dumpfile == InvalidPid)
+		apw_state->pid_using_dumpfile = MyProcPid;
+	else
+	{
+		LWLockRelease(&apw_state->lock);
+		ereport(LOG,
+				(errmsg("skipping prewarm because block dump file is being written by PID %d",
+						(int) apw_state->pid_using_dumpfile)));
+		return;
+	}
+	LWLockRelease(&apw_state->lock);
+
+	/*
+	 * Open the block dump file.  Exit quietly if it doesn't exist, but report
+	 * any other error.
+	 */
+	file = AllocateFile(AUTOPREWARM_FILE, "r");
+	if (!file)
+	{
+		if (errno == ENOENT)
+		{
+			LWLockAcquire(&apw_state->lock, LW_EXCLUSIVE);
+			apw_state->pid_using_dumpfile = InvalidPid;
+			LWLockRelease(&apw_state->lock);
+			return;				/* No file to load. */
+		}
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read file \"%s\": %m",
+						AUTOPREWARM_FILE)));
+	}
+
+	/* First line of the file is a record count. */
+	if (fscanf(file, "<<%d>>\n", &num_elements) != 1)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read from file \"%s\": %m",
+						AUTOPREWARM_FILE)));
+
+	if (num_elements < 0 ||
+		(Size) num_elements > MaxAllocHugeSize / sizeof(BlockInfoRecord))
+		ereport(ERROR,
+				(errmsg("invalid block count %d in file \"%s\"",
+						num_elements, AUTOPREWARM_FILE)));
+
+	/* Read the records. */
+	blkinfo = (BlockInfoRecord *)
+		MemoryContextAllocHuge(CurrentMemoryContext,
+							   sizeof(BlockInfoRecord) * Max(num_elements, 1));
+	for (i = 0; i < num_elements; i++)
+	{
+		unsigned	forknum;
+
+		if (fscanf(file, "%u,%u,%u,%u,%u\n", &blkinfo[i].database,
+				   &blkinfo[i].tablespace, &blkinfo[i].filenode,
+				   &forknum, &blkinfo[i].blocknum) != 5)
+			ereport(ERROR,
+					(errmsg("autoprewarm block dump file is corrupted at line %d",
+							i + 1)));
+		blkinfo[i].forknum = forknum;
+	}
+
+	FreeFile(file);
+
+	/* Sort the blocks to be loaded, so that each file is read in order. */
+	pg_qsort(blkinfo, num_elements, sizeof(BlockInfoRecord),
+			 apw_compare_blockinfo);
+
+	/*
+	 * Divide the blocks into ranges, each of which belongs to one database;
+	 * the blocks of global objects, which sort first, are combined with the
+	 * first database.  A database with many blocks is split into up to
+	 * maxworkers ranges, so that they can be loaded concurrently.  We can't
+	 * have more ranges than blocks.
+	 */
+	ranges = (AutoPrewarmRange *)
+		MemoryContextAllocHuge(CurrentMemoryContext,
+							   sizeof(AutoPrewarmRange) * Max(num_elements, 1));
+	nranges = 0;
+	i = 0;
+	while (i < num_elements)
+	{
+		Oid			current_db = blkinfo[i].database;
+		int			j;
+		int			nsplit;
+		int			k;
+
+		/*
+		 * Advance j to the first BlockInfoRecord that does not belong to this
+		 * database.
+		 */
+		j = i + 1;
+		while (j < num_elements)
+		{
+			if (current_db != blkinfo[j].database)
+			{
+				/*
+				 * Combine BlockRecordInfos for global objects with those of
+				 * the database.
+				 */
+				if (current_db != InvalidOid)
+					break;
+				current_db = blkinfo[j].database;
+			}
+
+			j++;
+		}
+
+		/*
+		 * If we reach this point with current_db == InvalidOid, then only
+		 * BlockRecordInfos belonging to global objects exist.  We can't
+		 * prewarm without a database connection, so just bail out.
+		 */
+		if (current_db == InvalidOid)
+			break;
+
+		nsplit = Min(maxworkers, (j - i + APW_MIN_RANGE_BLOCKS - 1) /
+					 APW_MIN_RANGE_BLOCKS);
+		for (k = 0; k < nsplit; k++)
+		{
+			ranges[nranges].database = current_db;
+			ranges[nranges].start_idx = i + (int) ((int64) (j - i) * k / nsplit);
+			ranges[nranges].stop_idx = i + (int) ((int64) (j - i) * (k + 1) / nsplit);
+			nranges++;
+		}
+
+		i = j;
+	}
+
+	if (nranges == 0)
+	{
+		LWLockAcquire(&apw_state->lock, LW_EXCLUSIVE);
+		apw_state->pid_using_dumpfile = InvalidPid;
+		LWLockRelease(&apw_state->lock);
+		return;
+	}
+
+	/* Put the ranges and blocks into a dynamic shared memory segment. */
+	segsize = add_size(MAXALIGN(sizeof(AutoPrewarmBlockList)),
+					   MAXALIGN(mul_size(sizeof(AutoPrewarmRange), nranges)));
+	segsize = add_size(segsize,
+					   mul_size(sizeof(BlockInfoRecord), num_elements));
+	seg = dsm_create(segsize, 0);
+	list = (AutoPrewarmBlockList *) dsm_segment_address(seg);
+	list->nranges = nranges;
+	list->nblocks = num_elements;
+	pg_atomic_init_u64(&list->prewarmed_blocks, 0);
+	memcpy(APW_RANGES(list), ranges, sizeof(AutoPrewarmRange) * nranges);
+	memcpy(APW_BLOCKS(list), blkinfo, sizeof(BlockInfoRecord) * num_elements);
+	pfree(ranges);
+	pfree(blkinfo);
+
+	apw_state->block_info_handle = dsm_segment_handle(seg);
+
+	/*
+	 * Launch a worker for each range, keeping up to maxworkers of them
+	 * running.  Stop launching once the buffer pool is full, since loading
+	 * more blocks would only evict ones we just loaded, or once we're told
+	 * to shut down.
+	 */
+	handles = (BackgroundWorkerHandle **)
+		palloc(sizeof(BackgroundWorkerHandle *) * maxworkers);
+	for (next_range = 0; next_range < nranges; next_range++)
+	{
+		apw_wait_for_workers(handles, &nrunning, maxworkers);
+
+		if (got_sigterm || !have_free_buffer())
+			break;
+
+		if (!apw_start_database_worker(next_range, &handles[nrunning]))
+			break;
+		nrunning++;
+	}
+
+	/* Wait for the workers we launched to finish. */
+	apw_wait_for_workers(handles, &nrunning, 1);
+	pfree(handles);
+
+	/* Clean up. */
+	ereport(LOG,
+			(errmsg("autoprewarm successfully prewarmed " UINT64_FORMAT
+					" of %d previously-loaded blocks",
+					pg_atomic_read_u64(&list->prewarmed_blocks),
+					num_elements)));
+
+	dsm_detach(seg);
+	LWLockAcquire(&apw_state->lock, LW_EXCLUSIVE);
+	apw_state->pid_using_dumpfile = InvalidPid;
+	LWLockRelease(&apw_state->lock);
+}
+
+/*
+ * Wait until fewer than limit of the per-database workers whose handles are
+ * in handles[0 .. *nrunning - 1] are running, and remove those that have
+ * exited from the array.
+ *
+ * If we're told to shut down, we terminate the workers and wait for them to
+ * exit, as they use our dynamic shared memory segment.
+ */
+static void
+apw_wait_for_workers(BackgroundWorkerHandle **handles, int *nrunning,
+					 int limit)
+{
+	for (;;)
+	{
+		int			i;
+		int			rc;
+
+		for (i = 0; i < *nrunning;)
+		{
+			pid_t		pid;
+
+			if (got_sigterm)
+				TerminateBackgroundWorker(handles[i]);
+
+			if (GetBackgroundWorkerPid(handles[i], &pid) == BGWH_STOPPED)
+			{
+				pfree(handles[i]);
+				handles[i] = handles[--(*nrunning)];
+			}
+			else
+				i++;
+		}
+
+		if (*nrunning < limit || *nrunning == 0)
+			break;
+
+		/* We'll be signalled when one of them exits. */
+		rc = WaitLatch(MyLatch, WL_LATCH_SET | WL_POSTMASTER_DEATH, -1L);
+		ResetLatch(MyLatch);
+		if (rc & WL_POSTMASTER_DEATH)
+			proc_exit(1);
+	}
+}
+
+/*
+ * Prewarm one range of the block list, all of whose blocks belong to the
+ * database we connect to or to global objects.
+ */
+void
+autoprewarm_database_main(Datum main_arg)
+{
+	int			range_idx = DatumGetInt32(main_arg);
+	AutoPrewarmBlockList *list;
+	AutoPrewarmRange *range;
+	BlockInfoRecord *block_info;
+	dsm_segment *seg;
+	int			pos;
+	int			prefetch_pos;
+	BlockInfoRecord *old_blk = NULL;
+	BlockNumber nblocks = 0;
+	Relation	rel = NULL;
+	uint64		prewarmed_blocks = 0;
+
+	/* Establish signal handlers; once that's done, unblock signals. */
+	pqsignal(SIGTERM, die);
+	BackgroundWorkerUnblockSignals();
+
+	/* Connect to correct database and get block information. */
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, "autoprewarm worker");
+	apw_init_shmem();
+	seg = dsm_attach(apw_state->block_info_handle);
+	if (seg == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("could not map dynamic shared memory segment")));
+	list = (AutoPrewarmBlockList *) dsm_segment_address(seg);
+	Assert(range_idx >= 0 && range_idx < list->nranges);
+	range = &APW_RANGES(list)[range_idx];
+	block_info = APW_BLOCKS(list);
+
+	BackgroundWorkerInitializeConnectionByOid(range->database, InvalidOid);
+
+	/*
+	 * Loop until we run out of blocks to prewarm or until we run out of free
+	 * buffers.
+	 */
+	prefetch_pos = range->start_idx;
+	for (pos = range->start_idx;
+		 pos < range->stop_idx && have_free_buffer();
+		 pos++)
+	{
+		BlockInfoRecord *blk = &block_info[pos];
+		Buffer		buf;
+
+		CHECK_FOR_INTERRUPTS();
+
+		/*
+		 * As soon as we encounter a block of a new relation, close the old
+		 * relation.  Note that rel will be NULL if try_relation_open failed
+		 * previously; in that case, there is nothing to close.
+		 */
+		if (old_blk != NULL &&
+			(old_blk->tablespace != blk->tablespace ||
+			 old_blk->filenode != blk->filenode) &&
+			rel != NULL)
+		{
+			relation_close(rel, AccessShareLock);
+			rel = NULL;
+			CommitTransactionCommand();
+		}
+
+		/*
+		 * Try to open each new relation, but only once, when we first
+		 * encounter it.  If it's been dropped, skip the associated blocks.
+		 */
+		if (old_blk == NULL ||
+			old_blk->tablespace != blk->tablespace ||
+			old_blk->filenode != blk->filenode)
+		{
+			Oid			reloid;
+
+			Assert(rel == NULL);
+			StartTransactionCommand();
+			reloid = RelidByRelfilenode(blk->tablespace, blk->filenode);
+			if (OidIsValid(reloid))
+				rel = try_relation_open(reloid, AccessShareLock);
+
+			if (!rel)
+				CommitTransactionCommand();
+		}
+		if (!rel)
+		{
+			old_blk = blk;
+			continue;
+		}
+
+		/* Once per fork, check for fork existence and size. */
+		if (old_blk == NULL ||
+			old_blk->tablespace != blk->tablespace ||
+			old_blk->filenode != blk->filenode ||
+			old_blk->forknum != blk->forknum)
+		{
+			RelationOpenSmgr(rel);
+
+			/*
+			 * smgrexists is not safe for illegal forknum, hence check whether
+			 * the passed forknum is valid before using it in smgrexists.
+			 */
+			if (blk->forknum > InvalidForkNumber &&
+				blk->forknum <= MAX_FORKNUM &&
+				smgrexists(rel->rd_smgr, blk->forknum))
+				nblocks = RelationGetNumberOfBlocksInFork(rel, blk->forknum);
+			else
+				nblocks = 0;
+		}
+
+		/* Check whether blocknum is valid and within fork file size. */
+		if (blk->blocknum >= nblocks)
+		{
+			/* Move to next forknum. */
+			old_blk = blk;
+			continue;
+		}
+
+#ifdef USE_PREFETCH
+
+		/*
+		 * Have the kernel start reading the next few blocks of the same fork
+		 * while we read this one.
+		 */
+		if (prefetch_pos <= pos)
+			prefetch_pos = pos + 1;
+		while (prefetch_pos < range->stop_idx &&
+			   prefetch_pos <= pos + APW_PREFETCH_DISTANCE)
+		{
+			BlockInfoRecord *pblk = &block_info[prefetch_pos];
+
+			if (pblk->tablespace != blk->tablespace ||
+				pblk->filenode != blk->filenode ||
+				pblk->forknum != blk->forknum)
+				break;
+			if (pblk->blocknum < nblocks)
+				PrefetchBuffer(rel, pblk->forknum, pblk->blocknum);
+			prefetch_pos++;
+		}
+#endif
+
+		/* Prewarm buffer. */
+		buf = ReadBufferExtended(rel, blk->forknum, blk->blocknum, RBM_NORMAL,
+								 NULL);
+		if (BufferIsValid(buf))
+		{
+			prewarmed_blocks++;
+			ReleaseBuffer(buf);
+		}
+
+		old_blk = blk;
+	}
+
+	pg_atomic_fetch_add_u64(&list->prewarmed_blocks, prewarmed_blocks);
+	dsm_detach(seg);
+
+	/* Release lock on previous relation. */
+	if (rel)
+	{
+		relation_close(rel, AccessShareLock);
+		CommitTransactionCommand();
+	}
+}
+
+/*
+ * Dump information on blocks in shared buffers.  We use a text format here
+ * so that it's easy to understand and even change the file contents if
+ * necessary.
+ * Returns the number of blocks dumped.
+ */
+static int
+apw_dump_now(bool is_bgworker, bool dump_unlogged)
+{
+	int			num_blocks;
+	int			i;
+	int			ret;
+	BlockInfoRecord *block_info_array;
+	volatile BufferDesc *bufHdr;
+	FILE	   *file;
+	char		transient_dump_file_path[MAXPGPATH];
+	pid_t		pid;
+
+	LWLockAcquire(&apw_state->lock, LW_EXCLUSIVE);
+	pid = apw_state->pid_using_dumpfile;
+	if (apw_state->pid_using_dumpfile == InvalidPid)
+		apw_state->pid_using_dumpfile = MyProcPid;
+	LWLockRelease(&apw_state->lock);
+
+	if (pid != InvalidPid)
+	{
+		if (!is_bgworker)
+			ereport(ERROR,
+					(errmsg("could not perform block dump because dump file is being used by PID %d",
+							(int) apw_state->pid_using_dumpfile)));
+
+		ereport(LOG,
+				(errmsg("skipping block dump because it is already being performed by PID %d",
+						(int) apw_state->pid_using_dumpfile)));
+		return 0;
+	}
+
+	block_info_array = (BlockInfoRecord *)
+		MemoryContextAllocHuge(CurrentMemoryContext,
+							   sizeof(BlockInfoRecord) * NBuffers);
+
+	for (num_blocks = 0, i = 0; i < NBuffers; i++)
+	{
+		uint32		buf_state;
+
+		CHECK_FOR_INTERRUPTS();
+
+		bufHdr = GetBufferDescriptor(i);
+
+		/* Lock each buffer header before inspecting. */
+		buf_state = LockBufHdr(bufHdr);
+
+		/*
+		 * Unlogged tables will be automatically truncated after a crash or
+		 * unclean shutdown.  In such cases we need not prewarm them.  Dump
+		 * them only if requested by caller.
+		 */
+		if (buf_state & BM_TAG_VALID &&
+			((buf_state & BM_PERMANENT) || dump_unlogged))
+		{
+			block_info_array[num_blocks].database = bufHdr->tag.rnode.dbNode;
+			block_info_array[num_blocks].tablespace = bufHdr->tag.rnode.spcNode;
+			block_info_array[num_blocks].filenode = bufHdr->tag.rnode.relNode;
+			block_info_array[num_blocks].forknum = bufHdr->tag.forkNum;
+			block_info_array[num_blocks].blocknum = bufHdr->tag.blockNum;
+			++num_blocks;
+		}
+
+		UnlockBufHdr(bufHdr, buf_state);
+	}
+
+	snprintf(transient_dump_file_path, MAXPGPATH, "%s.tmp", AUTOPREWARM_FILE);
+	file = AllocateFile(transient_dump_file_path, "w");
+	if (!file)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not open file \"%s\": %m",
+						transient_dump_file_path)));
+
+	ret = fprintf(file, "<<%d>>\n", num_blocks);
+	if (ret < 0)
+	{
+		int			save_errno = errno;
+
+		FreeFile(file);
+		unlink(transient_dump_file_path);
+		errno = save_errno;
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write to file \"%s\": %m",
+						transient_dump_file_path)));
+	}
+
+	for (i = 0; i < num_blocks; i++)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		ret = fprintf(file, "%u,%u,%u,%u,%u\n",
+					  block_info_array[i].database,
+					  block_info_array[i].tablespace,
+					  block_info_array[i].filenode,
+					  (uint32) block_info_array[i].forknum,
+					  block_info_array[i].blocknum);
+		if (ret < 0)
+		{
+			int			save_errno = errno;
+
+			FreeFile(file);
+			unlink(transient_dump_file_path);
+			errno = save_errno;
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not write to file \"%s\": %m",
+							transient_dump_file_path)));
+		}
+	}
+
+	pfree(block_info_array);
+
+	/*
+	 * Rename transient_dump_file_path to AUTOPREWARM_FILE to make things
+	 * permanent.
+	 */
+	if (fflush(file) != 0 || pg_fsync(fileno(file)) != 0 ||
+		FreeFile(file) != 0)
+	{
+		int			save_errno = errno;
+
+		unlink(transient_dump_file_path);
+		errno = save_errno;
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write to file \"%s\": %m",
+						transient_dump_file_path)));
+	}
+
+	if (rename(transient_dump_file_path, AUTOPREWARM_FILE) != 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not rename file \"%s\" to \"%s\": %m",
+						transient_dump_file_path, AUTOPREWARM_FILE)));
+
+	apw_state->pid_using_dumpfile = InvalidPid;
+
+	ereport(DEBUG1,
+			(errmsg("wrote block details for %d blocks", num_blocks)));
+	return num_blocks;
+}
+
+/*
+ * SQL-callable function to launch autoprewarm.
+ */
+Datum
+autoprewarm_start_worker(PG_FUNCTION_ARGS)
+{
+	pid_t		pid;
+
+	if (!autoprewarm)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("autoprewarm is disabled")));
+
+	apw_init_shmem();
+	LWLockAcquire(&apw_state->lock, LW_EXCLUSIVE);
+	pid = apw_state->bgworker_pid;
+	LWLockRelease(&apw_state->lock);
+
+	if (pid != InvalidPid)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("autoprewarm worker is already running under PID %d",
+						(int) pid)));
+
+	apw_start_master_worker();
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * SQL-callable function to perform an immediate block dump.
+ *
+ * Note: this is declared to return int8, as insurance against some
+ * very distant day when we might make NBuffers wider than int.
+ */
+Datum
+autoprewarm_dump_now(PG_FUNCTION_ARGS)
+{
+	int			num_blocks;
+
+	apw_init_shmem();
+
+	PG_ENSURE_ERROR_CLEANUP(apw_detach_shmem, 0);
+	{
+		num_blocks = apw_dump_now(false, true);
+	}
+	PG_END_ENSURE_ERROR_CLEANUP(apw_detach_shmem, 0);
+
+	PG_RETURN_INT64((int64) num_blocks);
+}
+
+/*
+ * Allocate and initialize autoprewarm related shared memory, if not already
+ * done, and set up backend-local pointer to that state.  Returns true if an
+ * existing shared memory segment was found.
+ */
+static bool
+apw_init_shmem(void)
+{
+	bool		found;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+	apw_state = ShmemInitStruct("autoprewarm",
+								sizeof(AutoPrewarmSharedState),
+								&found);
+	if (!found)
+	{
+		/* First time through ... */
+		apw_state->tranche_id = LWLockNewTrancheId();
+		LWLockInitialize(&apw_state->lock, apw_state->tranche_id);
+		apw_state->bgworker_pid = InvalidPid;
+		apw_state->pid_using_dumpfile = InvalidPid;
+	}
+	LWLockRelease(AddinShmemInitLock);
+
+	apw_tranche.name = "autoprewarm";
+	apw_tranche.array_base = &apw_state->lock;
+	apw_tranche.array_stride = sizeof(LWLock);
+	LWLockRegisterTranche(apw_state->tranche_id, &apw_tranche);
+
+	return found;
+}
+
+/*
+ * Clear our PID from autoprewarm shared state.
+ */
+static void
+apw_detach_shmem(int code, Datum arg)
+{
+	LWLockAcquire(&apw_state->lock, LW_EXCLUSIVE);
+	if (apw_state->pid_using_dumpfile == MyProcPid)
+		apw_state->pid_using_dumpfile = InvalidPid;
+	if (apw_state->bgworker_pid == MyProcPid)
+		apw_state->bgworker_pid = InvalidPid;
+	LWLockRelease(&apw_state->lock);
+}
+
+/*
+ * Start autoprewarm master worker process.
+ */
+static void
+apw_start_master_worker(void)
+{
+	BackgroundWorker worker;
+	BackgroundWorkerHandle *handle;
+	BgwHandleStatus status;
+	pid_t		pid;
+
+	MemSet(&worker, 0, sizeof(BackgroundWorker));
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS;
+	worker.bgw_start_time = BgWorkerStart_ConsistentState;
+	worker.bgw_restart_time = BGW_NEVER_RESTART;
+	strcpy(worker.bgw_library_name, "pg_prewarm");
+	strcpy(worker.bgw_function_name, "autoprewarm_main");
+	strcpy(worker.bgw_name, "autoprewarm master");
+
+	if (process_shared_preload_libraries_in_progress)
+	{
+		RegisterBackgroundWorker(&worker);
+		return;
+	}
+
+	/* must set notify PID to wait for startup */
+	worker.bgw_notify_pid = MyProcPid;
+
+	if (!RegisterDynamicBackgroundWorker(&worker, &handle))
+		ereport(ERROR,
+				(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+				 errmsg("could not register background process"),
+			   errhint("You may need to increase max_worker_processes.")));
+
+	status = WaitForBackgroundWorkerStartup(handle, &pid);
+	if (status != BGWH_STARTED)
+		ereport(ERROR,
+				(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+				 errmsg("could not start background process"),
+			   errhint("More details may be available in the server log.")));
+}
+
+/*
+ * Start a per-database worker to load the given range of the block list.
+ * Returns false, after logging why, if the worker can't be registered.
+ */
+static bool
+apw_start_database_worker(int range_idx, BackgroundWorkerHandle **handle)
+{
+	BackgroundWorker worker;
+
+	MemSet(&worker, 0, sizeof(BackgroundWorker));
+	worker.bgw_flags =
+		BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
+	worker.bgw_start_time = BgWorkerStart_ConsistentState;
+	worker.bgw_restart_time = BGW_NEVER_RESTART;
+	strcpy(worker.bgw_library_name, "pg_prewarm");
+	strcpy(worker.bgw_function_name, "autoprewarm_database_main");
+	strcpy(worker.bgw_name, "autoprewarm worker");
+	worker.bgw_main_arg = Int32GetDatum(range_idx);
+
+	/* must set notify PID to wait for shutdown */
+	worker.bgw_notify_pid = MyProcPid;
+
+	if (!RegisterDynamicBackgroundWorker(&worker, handle))
+	{
+		ereport(LOG,
+				(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+				 errmsg("registering dynamic bgworker autoprewarm failed"),
+				 errhint("Consider increasing configuration parameter \"max_worker_processes\".")));
+		return false;
+	}
+
+	return true;
+}
+
+/* Compare member elements to check whether they are not equal. */
+#define cmp_member_elem(fld)	\
+do { \
+	if (a->fld < b->fld)		\
+		return -1;				\
+	else if (a->fld > b->fld)	\
+		return 1;				\
+} while(0)
+
+/*
+ * apw_compare_blockinfo
+ *
+ * We depend on all records for a particular database being consecutive,
+ * so that the block list can be divided into per-database ranges.  Sorting
+ * by tablespace, filenode, forknum, and blocknum isn't critical for
+ * correctness, but helps us get a sequential I/O pattern.
+ */
+static int
+apw_compare_blockinfo(const void *p, const void *q)
+{
+	const BlockInfoRecord *a = (const BlockInfoRecord *) p;
+	const BlockInfoRecord *b = (const BlockInfoRecord *) q;
+
+	cmp_member_elem(database);
+	cmp_member_elem(tablespace);
+	cmp_member_elem(filenode);
+	cmp_member_elem(forknum);
+	cmp_member_elem(blocknum);
+
+	return 0;
+}
+
+/*
+ * Signal handler for SIGTERM
+ */
+static void
+apw_sigterm_handler(SIGNAL_ARGS)
+{
+	int			save_errno = errno;
+
+	got_sigterm = true;
+
+	SetLatch(MyLatch);
+
+	errno = save_errno;
+}
+
+/*
+ * Signal handler for SIGHUP
+ */
+static void
+apw_sighup_handler(SIGNAL_ARGS)
+{
+	int			save_errno = errno;
+
+	got_sighup = true;
+
+	SetLatch(MyLatch);
+
+	errno = save_errno;
+}
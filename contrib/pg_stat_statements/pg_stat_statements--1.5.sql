@@ -1,4 +1,4 @@
-/* contrib/pg_stat_statements/pg_stat_statements--1.3.sql */
+/* contrib/pg_stat_statements/pg_stat_statements--1.5.sql */
 
 -- complain if script is sourced in psql, rather than via CREATE EXTENSION
 \echo Use "CREATE EXTENSION pg_stat_statements" to load this file. \quit
@@ -10,6 +10,7 @@ AS 'MODULE_PATHNAME'
 LANGUAGE C;
 
 CREATE FUNCTION pg_stat_statements(IN showtext boolean,
+    IN changed_since timestamptz DEFAULT '-infinity',
     OUT userid oid,
     OUT dbid oid,
     OUT queryid bigint,
@@ -32,10 +33,30 @@ CREATE FUNCTION pg_stat_statements(IN showtext boolean,
     OUT temp_blks_read int8,
     OUT temp_blks_written int8,
     OUT blk_read_time float8,
-    OUT blk_write_time float8
+    OUT blk_write_time float8,
+    OUT wal_records int8,
+    OUT wal_fpi int8,
+    OUT wal_bytes numeric,
+    OUT plans int8,
+    OUT total_plan_time float8,
+    OUT min_plan_time float8,
+    OUT max_plan_time float8,
+    OUT mean_plan_time float8,
+    OUT stddev_plan_time float8,
+    OUT exec_time_hist int8[],
+    OUT stats_since timestamptz,
+    OUT last_call timestamptz
 )
 RETURNS SETOF record
-AS 'MODULE_PATHNAME', 'pg_stat_statements_1_3'
+AS 'MODULE_PATHNAME', 'pg_stat_statements_1_5'
+LANGUAGE C STRICT VOLATILE;
+
+CREATE FUNCTION pg_stat_statements_info(
+    OUT dealloc int8,
+    OUT stats_reset timestamptz
+)
+RETURNS record
+AS 'MODULE_PATHNAME'
 LANGUAGE C STRICT VOLATILE;
 
 -- Register a view on the function for ease of use.
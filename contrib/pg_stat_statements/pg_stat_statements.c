@@ -28,24 +28,37 @@
  *
  * To facilitate presenting entries to users, we create "representative" query
  * strings in which constants are replaced with '?' characters, to make it
- * clearer what a normalized entry can represent.  To save on shared memory,
- * and to avoid having to truncate oversized query strings, we store these
- * strings in a temporary external query-texts file.  Offsets into this
- * file are kept in shared memory.
+ * clearer what a normalized entry can represent.  To avoid having to reserve
+ * room for the longest possible string in every hashtable entry, these
+ * strings are kept in a separate area of shared memory, whose size is set by
+ * pg_stat_statements.query_texts_size.  New texts are appended at the end of
+ * the area, and offsets into it are kept in the hashtable entries.  When the
+ * area fills up, it is garbage-collected: the texts of deallocated entries
+ * are dropped, and entries whose texts are identical share a single copy.
  *
- * Note about locking issues: to create or delete an entry in the shared
- * hashtable, one must hold pgss->lock exclusively.  Modifying any field
- * in an entry except the counters requires the same.  To look up an entry,
- * one must hold the lock shared.  To read or update the counters within
- * an entry, one must hold the lock shared or exclusive (so the entry doesn't
- * disappear!) and also take the entry's mutex spinlock.
- * The shared state variable pgss->extent (the next free spot in the external
- * query-text file) should be accessed only while holding either the
- * pgss->mutex spinlock, or exclusive lock on pgss->lock.  We use the mutex to
- * allow reserving file space while holding only shared lock on pgss->lock.
- * Rewriting the entire external query-text file, eg for garbage collection,
- * requires holding pgss->lock exclusively; this allows individual entries
- * in the file to be read or written while holding only shared lock.
+ * Note about locking issues: the shared hashtable is partitioned, and each
+ * partition has its own lock in pgss->locks, chosen by the hash code of the
+ * entry's key.  To create an entry in the shared hashtable, one must hold
+ * the lock of its partition exclusively.  Deleting entries, which is only
+ * done to make room for new ones or when resetting, requires holding all
+ * the partition locks exclusively, as does modifying any field in an entry
+ * except the counters.  To look up an entry, one must hold its partition
+ * lock shared.  To read or update the counters within an entry, one must
+ * hold the partition lock shared or exclusive (so the entry doesn't
+ * disappear!) and also take the entry's mutex spinlock.  Scanning the whole
+ * hashtable requires holding all the partition locks.
+ * The shared state variable pgss->extent (the next free spot in the query
+ * text area) should be accessed only while holding either the pgss->mutex
+ * spinlock, or all the partition locks exclusively.  We use the mutex to
+ * allow reserving space while holding only one partition lock.  Moving
+ * texts around, eg for garbage collection, requires holding all the
+ * partition locks exclusively; this allows individual texts in the area to
+ * be read or written while holding only one partition lock, shared.
+ *
+ * To reduce contention on the entries of the most frequent statements,
+ * backends can also accumulate the statistics of entries they have seen
+ * recently in local memory, and add them to the shared entries only every
+ * pg_stat_statements.flush_interval milliseconds.
  *
  *
  * Copyright (c) 2008-2015, PostgreSQL Global Development Group
@@ -58,14 +71,16 @@
 #include "postgres.h"
 
 #include <math.h>
-#include <sys/stat.h>
 #include <unistd.h>
 
 #include "access/hash.h"
+#include "access/htup_details.h"
+#include "catalog/pg_type.h"
 #include "executor/instrument.h"
 #include "funcapi.h"
 #include "mb/pg_wchar.h"
 #include "miscadmin.h"
+#include "optimizer/planner.h"
 #include "parser/analyze.h"
 #include "parser/parsetree.h"
 #include "parser/scanner.h"
@@ -74,8 +89,10 @@
 #include "storage/ipc.h"
 #include "storage/spin.h"
 #include "tcop/utility.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/memutils.h"
+#include "utils/timestamp.h"
 
 PG_MODULE_MAGIC;
 
@@ -83,17 +100,13 @@ PG_MODULE_MAGIC;
 #define PGSS_DUMP_FILE	PGSTAT_STAT_PERMANENT_DIRECTORY "/pg_stat_statements.stat"
 
 /*
- * Location of external query text file.  We don't keep it in the core
- * system's stats_temp_directory.  The core system can safely use that GUC
- * setting, because the statistics collector temp file paths are set only once
- * as part of changing the GUC, but pg_stat_statements has no way of avoiding
- * race conditions.  Besides, we only expect modest, infrequent I/O for query
- * strings, so placing the file on a faster filesystem is not compelling.
+ * Location of the external query text file used by releases before 1.5,
+ * which we remove if we find it.
  */
 #define PGSS_TEXT_FILE	PG_STAT_TMP_DIR "/pgss_query_texts.stat"
 
 /* Magic number identifying the stats file format */
-static const uint32 PGSS_FILE_HEADER = 0x20140125;
+static const uint32 PGSS_FILE_HEADER = 0x20151017;
 
 /* PostgreSQL major version number, changes in which invalidate all entries */
 static const uint32 PGSS_PG_MAJOR_VERSION = PG_VERSION_NUM / 100;
@@ -102,13 +115,24 @@ static const uint32 PGSS_PG_MAJOR_VERSION = PG_VERSION_NUM / 100;
 #define USAGE_EXEC(duration)	(1.0)
 #define USAGE_INIT				(1.0)	/* including initial planning */
 #define ASSUMED_MEDIAN_INIT		(10.0)	/* initial assumed median usage */
-#define ASSUMED_LENGTH_INIT		1024	/* initial assumed mean query length */
 #define USAGE_DECREASE_FACTOR	(0.99)	/* decreased every entry_dealloc */
 #define STICKY_DECREASE_FACTOR	(0.50)	/* factor for sticky entries */
 #define USAGE_DEALLOC_PERCENT	5		/* free this % of entries at once */
 
 #define JUMBLE_SIZE				1024	/* query serialization buffer size */
 
+/* Number of partitions of the shared hashtable, each with its own lock */
+#define PGSS_NUM_PARTITIONS		16
+#define PGSS_PARTITION_LOCK(hashcode) \
+	(pgss->locks[(hashcode) % PGSS_NUM_PARTITIONS])
+
+/*
+ * Buckets of the execution time histogram.  Bucket i counts executions that
+ * took less than 0.1 * 10^i milliseconds, except the last one, which counts
+ * the ones that took 10 seconds or more.
+ */
+#define PGSS_TIME_BUCKETS		7
+
 /*
  * Extension version number, for supporting older extension versions' objects
  */
@@ -117,9 +141,20 @@ typedef enum pgssVersion
 	PGSS_V1_0 = 0,
 	PGSS_V1_1,
 	PGSS_V1_2,
-	PGSS_V1_3
+	PGSS_V1_3,
+	PGSS_V1_4,
+	PGSS_V1_5
 } pgssVersion;
 
+/*
+ * What pgss_store is asked to record: planning or execution of a statement
+ */
+typedef enum pgssStoreKind
+{
+	PGSS_PLAN,
+	PGSS_EXEC
+} pgssStoreKind;
+
 /*
  * Hashtable key that defines the identity of a hashtable entry.  We separate
  * queries by user and by database even if they are otherwise identical.
@@ -155,38 +190,69 @@ typedef struct Counters
 	int64		temp_blks_written;		/* # of temp blocks written */
 	double		blk_read_time;	/* time spent reading, in msec */
 	double		blk_write_time; /* time spent writing, in msec */
+	int64		wal_records;	/* # of WAL records generated */
+	int64		wal_fpi;		/* # of WAL full page images generated */
+	uint64		wal_bytes;		/* total amount of WAL bytes generated */
+	int64		time_hist[PGSS_TIME_BUCKETS];	/* # of executions by time */
+	TimestampTz last_call;		/* end of the latest execution */
+	int64		plans;			/* # of times planned */
+	double		total_plan_time;	/* total planning time, in msec */
+	double		min_plan_time;	/* minimum planning time in msec */
+	double		max_plan_time;	/* maximum planning time in msec */
+	double		mean_plan_time; /* mean planning time in msec */
+	double		sum_var_plan_time;	/* sum of variances in planning time */
 	double		usage;			/* usage factor */
 } Counters;
 
 /*
  * Statistics per statement
  *
- * Note: in event of a failure in garbage collection of the query text file,
- * we reset query_offset to zero and query_len to -1.  This will be seen as
- * an invalid state by qtext_fetch().
+ * Note: if a query text could not be stored, because it is too long to fit
+ * in the query text area, we set query_offset to zero and query_len to -1.
+ * This will be seen as an invalid state by qtext_fetch().
  */
 typedef struct pgssEntry
 {
 	pgssHashKey key;			/* hash key of entry - MUST BE FIRST */
 	Counters	counters;		/* the statistics for this query */
-	Size		query_offset;	/* query text offset in external file */
+	TimestampTz stats_since;	/* when the entry was created */
+	Size		query_offset;	/* query text offset in text area */
 	int			query_len;		/* # of valid bytes in query string */
 	int			encoding;		/* query text encoding */
 	slock_t		mutex;			/* protects the counters only */
 } pgssEntry;
 
+/*
+ * Statistics accumulated by this backend, not yet added to the shared entry
+ */
+typedef struct pgssPending
+{
+	pgssHashKey key;			/* hash key of entry - MUST BE FIRST */
+	Counters	counters;		/* the statistics to add */
+} pgssPending;
+
+/*
+ * Statistics about the module as a whole, reported by
+ * pg_stat_statements_info()
+ */
+typedef struct pgssGlobalStats
+{
+	int64		dealloc;		/* # of times entries were deallocated */
+	TimestampTz stats_reset;	/* when all entries were last reset */
+} pgssGlobalStats;
+
 /*
  * Global shared state
  */
 typedef struct pgssSharedState
 {
-	LWLock	   *lock;			/* protects hashtable search/modification */
+	LWLock	   *locks[PGSS_NUM_PARTITIONS];	/* protect hashtable partitions */
 	double		cur_median_usage;		/* current median usage in hashtable */
-	Size		mean_query_len; /* current mean entry text length */
+	Size		qtext_size;		/* size of the query text area */
+	pgssGlobalStats stats;		/* changed only with all locks exclusive */
 	slock_t		mutex;			/* protects following fields only: */
-	Size		extent;			/* current extent of query file */
-	int			n_writers;		/* number of active writers to query file */
-	int			gc_count;		/* query file garbage collection cycle count */
+	Size		extent;			/* current extent of query text area */
+	int			gc_count;		/* query text garbage collection cycle count */
 } pgssSharedState;
 
 /*
@@ -228,6 +294,7 @@ static int	nested_level = 0;
 /* Saved hook values in case of unload */
 static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
 static post_parse_analyze_hook_type prev_post_parse_analyze_hook = NULL;
+static planner_hook_type prev_planner_hook = NULL;
 static ExecutorStart_hook_type prev_ExecutorStart = NULL;
 static ExecutorRun_hook_type prev_ExecutorRun = NULL;
 static ExecutorFinish_hook_type prev_ExecutorFinish = NULL;
@@ -237,6 +304,12 @@ static ProcessUtility_hook_type prev_ProcessUtility = NULL;
 /* Links to shared memory state */
 static pgssSharedState *pgss = NULL;
 static HTAB *pgss_hash = NULL;
+static char *pgss_qtexts = NULL;
+
+/* Statistics accumulated by this backend, if any, and when last flushed */
+static HTAB *pgss_pending = NULL;
+static TimestampTz pgss_last_flush = 0;
+static bool pgss_shutdown_registered = false;
 
 /*---- GUC variables ----*/
 
@@ -256,8 +329,11 @@ static const struct config_enum_entry track_options[] =
 };
 
 static int	pgss_max;			/* max # statements to track */
+static int	pgss_query_texts_size;	/* size of query text area, in kB */
 static int	pgss_track;			/* tracking level */
 static bool pgss_track_utility; /* whether to track utility commands */
+static bool pgss_track_planning;	/* whether to track planning time */
+static int	pgss_flush_interval;	/* msec between flushes, or 0 */
 static bool pgss_save;			/* whether to save stats across shutdown */
 
 
@@ -281,11 +357,16 @@ void		_PG_fini(void);
 PG_FUNCTION_INFO_V1(pg_stat_statements_reset);
 PG_FUNCTION_INFO_V1(pg_stat_statements_1_2);
 PG_FUNCTION_INFO_V1(pg_stat_statements_1_3);
+PG_FUNCTION_INFO_V1(pg_stat_statements_1_4);
+PG_FUNCTION_INFO_V1(pg_stat_statements_1_5);
 PG_FUNCTION_INFO_V1(pg_stat_statements);
+PG_FUNCTION_INFO_V1(pg_stat_statements_info);
 
 static void pgss_shmem_startup(void);
 static void pgss_shmem_shutdown(int code, Datum arg);
 static void pgss_post_parse_analyze(ParseState *pstate, Query *query);
+static PlannedStmt *pgss_planner(Query *parse, int cursorOptions,
+			 ParamListInfo boundParams);
 static void pgss_ExecutorStart(QueryDesc *queryDesc, int eflags);
 static void pgss_ExecutorRun(QueryDesc *queryDesc,
 				 ScanDirection direction,
@@ -298,23 +379,35 @@ static void pgss_ProcessUtility(Node *parsetree, const char *queryString,
 static uint32 pgss_hash_fn(const void *key, Size keysize);
 static int	pgss_match_fn(const void *key1, const void *key2, Size keysize);
 static uint32 pgss_hash_string(const char *str);
+static void add_times(int64 n_a, volatile double *total, volatile double *min,
+		  volatile double *max, volatile double *mean, volatile double *sum_var,
+		  int64 n_b, double total_b, double min_b, double max_b,
+		  double mean_b, double sum_var_b);
+static void add_counters(volatile Counters *dst, const Counters *src);
+static int	time_bucket(double time);
+static void pgss_lock_all(LWLockMode mode);
+static void pgss_unlock_all(void);
+static void pgss_flush_pending(void);
+static void pgss_backend_shutdown(int code, Datum arg);
+static void pgss_remember_pending(pgssHashKey *key, TimestampTz now);
 static void pgss_store(const char *query, uint32 queryId,
-		   double total_time, uint64 rows,
+		   pgssStoreKind kind, double total_time, uint64 rows,
 		   const BufferUsage *bufusage,
+		   const WalUsage *walusage,
 		   pgssJumbleState *jstate);
 static void pg_stat_statements_internal(FunctionCallInfo fcinfo,
 							pgssVersion api_version,
-							bool showtext);
+							bool showtext,
+							TimestampTz changed_since);
 static Size pgss_memsize(void);
-static pgssEntry *entry_alloc(pgssHashKey *key, Size query_offset, int query_len,
-			int encoding, bool sticky);
+static pgssEntry *entry_alloc(pgssHashKey *key, uint32 hashcode,
+			Size query_offset, int query_len, int encoding, bool sticky);
 static void entry_dealloc(void);
 static bool qtext_store(const char *query, int query_len,
 			Size *query_offset, int *gc_count);
-static char *qtext_load_file(Size *buffer_size);
-static char *qtext_fetch(Size query_offset, int query_len,
-			char *buffer, Size buffer_size);
-static bool need_gc_qtexts(void);
+static bool qtext_store_exclusive(const char *query, int query_len,
+					  Size *query_offset);
+static char *qtext_fetch(Size query_offset, int query_len);
 static void gc_qtexts(void);
 static void entry_reset(void);
 static void AppendJumble(pgssJumbleState *jstate,
@@ -362,6 +455,19 @@ _PG_init(void)
 							NULL,
 							NULL);
 
+	DefineCustomIntVariable("pg_stat_statements.query_texts_size",
+							"Sets the amount of memory used to keep the texts of tracked statements.",
+							NULL,
+							&pgss_query_texts_size,
+							8192,
+							1024,
+							MAX_KILOBYTES,
+							PGC_POSTMASTER,
+							GUC_UNIT_KB,
+							NULL,
+							NULL,
+							NULL);
+
 	DefineCustomEnumVariable("pg_stat_statements.track",
 			   "Selects which statements are tracked by pg_stat_statements.",
 							 NULL,
@@ -385,6 +491,30 @@ _PG_init(void)
 							 NULL,
 							 NULL);
 
+	DefineCustomBoolVariable("pg_stat_statements.track_planning",
+		   "Selects whether planning time is tracked by pg_stat_statements.",
+							 NULL,
+							 &pgss_track_planning,
+							 false,
+							 PGC_SUSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomIntVariable("pg_stat_statements.flush_interval",
+							"Sets how long backends may accumulate statistics before adding them to the shared hashtable.",
+							"Zero adds them right away.",
+							&pgss_flush_interval,
+							0,
+							0,
+							INT_MAX / 1000,
+							PGC_SUSET,
+							GUC_UNIT_MS,
+							NULL,
+							NULL,
+							NULL);
+
 	DefineCustomBoolVariable("pg_stat_statements.save",
 			   "Save pg_stat_statements statistics across server shutdowns.",
 							 NULL,
@@ -404,7 +534,7 @@ _PG_init(void)
 	 * resources in pgss_shmem_startup().
 	 */
 	RequestAddinShmemSpace(pgss_memsize());
-	RequestAddinLWLocks(1);
+	RequestAddinLWLocks(PGSS_NUM_PARTITIONS);
 
 	/*
 	 * Install hooks.
@@ -413,6 +543,8 @@ _PG_init(void)
 	shmem_startup_hook = pgss_shmem_startup;
 	prev_post_parse_analyze_hook = post_parse_analyze_hook;
 	post_parse_analyze_hook = pgss_post_parse_analyze;
+	prev_planner_hook = planner_hook;
+	planner_hook = pgss_planner;
 	prev_ExecutorStart = ExecutorStart_hook;
 	ExecutorStart_hook = pgss_ExecutorStart;
 	prev_ExecutorRun = ExecutorRun_hook;
@@ -434,6 +566,7 @@ _PG_fini(void)
 	/* Uninstall hooks. */
 	shmem_startup_hook = prev_shmem_startup_hook;
 	post_parse_analyze_hook = prev_post_parse_analyze_hook;
+	planner_hook = prev_planner_hook;
 	ExecutorStart_hook = prev_ExecutorStart;
 	ExecutorRun_hook = prev_ExecutorRun;
 	ExecutorFinish_hook = prev_ExecutorFinish;
@@ -444,16 +577,14 @@ _PG_fini(void)
 /*
  * shmem_startup hook: allocate or attach to shared memory,
  * then load any pre-existing statistics from file.
- * Also create and load the query-texts file, which is expected to exist
- * (even if empty) while the module is enabled.
  */
 static void
 pgss_shmem_startup(void)
 {
 	bool		found;
+	bool		qtexts_found;
 	HASHCTL		info;
 	FILE	   *file = NULL;
-	FILE	   *qfile = NULL;
 	uint32		header;
 	int32		num;
 	int32		pgver;
@@ -467,6 +598,7 @@ pgss_shmem_startup(void)
 	/* reset in case this is a restart within the postmaster */
 	pgss = NULL;
 	pgss_hash = NULL;
+	pgss_qtexts = NULL;
 
 	/*
 	 * Create or attach to the shared memory state, including hash table
@@ -480,24 +612,35 @@ pgss_shmem_startup(void)
 	if (!found)
 	{
 		/* First time through ... */
-		pgss->lock = LWLockAssign();
+		int			i;
+
+		for (i = 0; i < PGSS_NUM_PARTITIONS; i++)
+			pgss->locks[i] = LWLockAssign();
 		pgss->cur_median_usage = ASSUMED_MEDIAN_INIT;
-		pgss->mean_query_len = ASSUMED_LENGTH_INIT;
+		pgss->qtext_size = (Size) pgss_query_texts_size * 1024;
+		pgss->stats.dealloc = 0;
+		pgss->stats.stats_reset = GetCurrentTimestamp();
 		SpinLockInit(&pgss->mutex);
 		pgss->extent = 0;
-		pgss->n_writers = 0;
 		pgss->gc_count = 0;
 	}
 
+	pgss_qtexts = ShmemInitStruct("pg_stat_statements query texts",
+								  pgss->qtext_size,
+								  &qtexts_found);
+	Assert(qtexts_found == found);
+
 	memset(&info, 0, sizeof(info));
 	info.keysize = sizeof(pgssHashKey);
 	info.entrysize = sizeof(pgssEntry);
 	info.hash = pgss_hash_fn;
 	info.match = pgss_match_fn;
+	info.num_partitions = PGSS_NUM_PARTITIONS;
 	pgss_hash = ShmemInitHash("pg_stat_statements hash",
 							  pgss_max, pgss_max,
 							  &info,
-							  HASH_ELEM | HASH_FUNCTION | HASH_COMPARE);
+							  HASH_ELEM | HASH_FUNCTION | HASH_COMPARE |
+							  HASH_PARTITION);
 
 	LWLockRelease(AddinShmemInitLock);
 
@@ -519,24 +662,16 @@ pgss_shmem_startup(void)
 	 * processes running when this code is reached.
 	 */
 
-	/* Unlink query text file possibly left over from crash */
+	/* Unlink query text file possibly left over from an older release */
 	unlink(PGSS_TEXT_FILE);
 
-	/* Allocate new query text temp file */
-	qfile = AllocateFile(PGSS_TEXT_FILE, PG_BINARY_W);
-	if (qfile == NULL)
-		goto write_error;
-
 	/*
 	 * If we were told not to load old statistics, we're done.  (Note we do
 	 * not try to unlink any old dump file in this case.  This seems a bit
 	 * questionable but it's the historical behavior.)
 	 */
 	if (!pgss_save)
-	{
-		FreeFile(qfile);
 		return;
-	}
 
 	/*
 	 * Attempt to load old statistics from the dump file.
@@ -547,7 +682,6 @@ pgss_shmem_startup(void)
 		if (errno != ENOENT)
 			goto read_error;
 		/* No existing persisted stats file, so we're done */
-		FreeFile(qfile);
 		return;
 	}
 
@@ -563,6 +697,9 @@ pgss_shmem_startup(void)
 		pgver != PGSS_PG_MAJOR_VERSION)
 		goto data_error;
 
+	if (fread(&pgss->stats, sizeof(pgssGlobalStats), 1, file) != 1)
+		goto read_error;
+
 	for (i = 0; i < num; i++)
 	{
 		pgssEntry	temp;
@@ -593,37 +730,30 @@ pgss_shmem_startup(void)
 		if (temp.counters.calls == 0)
 			continue;
 
-		/* Store the query text */
-		query_offset = pgss->extent;
-		if (fwrite(buffer, 1, temp.query_len + 1, qfile) != temp.query_len + 1)
-			goto write_error;
-		pgss->extent += temp.query_len + 1;
+		/* Store the query text, unless the text area is full already */
+		if (!qtext_store(buffer, temp.query_len, &query_offset, NULL))
+			continue;
 
 		/* make the hashtable entry (discards old entries if too many) */
-		entry = entry_alloc(&temp.key, query_offset, temp.query_len,
+		while (hash_get_num_entries(pgss_hash) >= pgss_max)
+			entry_dealloc();
+		entry = entry_alloc(&temp.key, get_hash_value(pgss_hash, &temp.key),
+							query_offset, temp.query_len,
 							temp.encoding,
 							false);
 
 		/* copy in the actual stats */
 		entry->counters = temp.counters;
+		entry->stats_since = temp.stats_since;
 	}
 
 	pfree(buffer);
 	FreeFile(file);
-	FreeFile(qfile);
 
 	/*
 	 * Remove the persisted stats file so it's not included in
 	 * backups/replication slaves, etc.  A new file will be written on next
 	 * shutdown.
-	 *
-	 * Note: it's okay if the PGSS_TEXT_FILE is included in a basebackup,
-	 * because we remove that file on startup; it acts inversely to
-	 * PGSS_DUMP_FILE, in that it is only supposed to be around when the
-	 * server is running, whereas PGSS_DUMP_FILE is only supposed to be around
-	 * when the server is not running.  Leaving the file creates no danger of
-	 * a newly restored database having a spurious record of execution costs,
-	 * which is what we're really concerned about here.
 	 */
 	unlink(PGSS_DUMP_FILE);
 
@@ -640,26 +770,13 @@ data_error:
 			(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
 			 errmsg("ignoring invalid data in pg_stat_statement file \"%s\"",
 					PGSS_DUMP_FILE)));
-	goto fail;
-write_error:
-	ereport(LOG,
-			(errcode_for_file_access(),
-			 errmsg("could not write pg_stat_statement file \"%s\": %m",
-					PGSS_TEXT_FILE)));
 fail:
 	if (buffer)
 		pfree(buffer);
 	if (file)
 		FreeFile(file);
-	if (qfile)
-		FreeFile(qfile);
 	/* If possible, throw away the bogus file; ignore any error */
 	unlink(PGSS_DUMP_FILE);
-
-	/*
-	 * Don't unlink PGSS_TEXT_FILE here; it should always be around while the
-	 * server is running with pg_stat_statements enabled
-	 */
 }
 
 /*
@@ -672,8 +789,6 @@ static void
 pgss_shmem_shutdown(int code, Datum arg)
 {
 	FILE	   *file;
-	char	   *qbuffer = NULL;
-	Size		qbuffer_size = 0;
 	HASH_SEQ_STATUS hash_seq;
 	int32		num_entries;
 	pgssEntry  *entry;
@@ -701,9 +816,7 @@ pgss_shmem_shutdown(int code, Datum arg)
 	num_entries = hash_get_num_entries(pgss_hash);
 	if (fwrite(&num_entries, sizeof(int32), 1, file) != 1)
 		goto error;
-
-	qbuffer = qtext_load_file(&qbuffer_size);
-	if (qbuffer == NULL)
+	if (fwrite(&pgss->stats, sizeof(pgssGlobalStats), 1, file) != 1)
 		goto error;
 
 	/*
@@ -714,8 +827,7 @@ pgss_shmem_shutdown(int code, Datum arg)
 	while ((entry = hash_seq_search(&hash_seq)) != NULL)
 	{
 		int			len = entry->query_len;
-		char	   *qstr = qtext_fetch(entry->query_offset, len,
-									   qbuffer, qbuffer_size);
+		char	   *qstr = qtext_fetch(entry->query_offset, len);
 
 		if (qstr == NULL)
 			continue;			/* Ignore any entries with bogus texts */
@@ -729,9 +841,6 @@ pgss_shmem_shutdown(int code, Datum arg)
 		}
 	}
 
-	free(qbuffer);
-	qbuffer = NULL;
-
 	if (FreeFile(file))
 	{
 		file = NULL;
@@ -747,9 +856,6 @@ pgss_shmem_shutdown(int code, Datum arg)
 				 errmsg("could not rename pg_stat_statement file \"%s\": %m",
 						PGSS_DUMP_FILE ".tmp")));
 
-	/* Unlink query-texts file; it's not needed while shutdown */
-	unlink(PGSS_TEXT_FILE);
-
 	return;
 
 error:
@@ -757,12 +863,9 @@ error:
 			(errcode_for_file_access(),
 			 errmsg("could not write pg_stat_statement file \"%s\": %m",
 					PGSS_DUMP_FILE ".tmp")));
-	if (qbuffer)
-		free(qbuffer);
 	if (file)
 		FreeFile(file);
 	unlink(PGSS_DUMP_FILE ".tmp");
-	unlink(PGSS_TEXT_FILE);
 }
 
 /*
@@ -821,17 +924,80 @@ pgss_post_parse_analyze(ParseState *pstate, Query *query)
 	 * create a hash table entry for the query, so that we can record the
 	 * normalized form of the query string.  If there were no such constants,
 	 * the normalized string would be the same as the query text anyway, so
-	 * there's no need for an early entry.
+	 * there's no need for an early entry, unless we are to record planning
+	 * time: the planner hook doesn't have the query text, so it can only add
+	 * to an existing entry.
 	 */
-	if (jstate.clocations_count > 0)
+	if (jstate.clocations_count > 0 ||
+		(pgss_track_planning && pgss_enabled()))
 		pgss_store(pstate->p_sourcetext,
 				   query->queryId,
+				   PGSS_EXEC,
 				   0,
 				   0,
 				   NULL,
+				   NULL,
 				   &jstate);
 }
 
+/*
+ * Planner hook: track planning time if needed
+ */
+static PlannedStmt *
+pgss_planner(Query *parse, int cursorOptions, ParamListInfo boundParams)
+{
+	PlannedStmt *result;
+
+	if (pgss_track_planning && pgss_enabled() && parse->queryId != 0)
+	{
+		instr_time	start;
+		instr_time	duration;
+
+		INSTR_TIME_SET_CURRENT(start);
+
+		/*
+		 * Statements executed while planning, eg to evaluate a function at
+		 * plan time, are nested ones.
+		 */
+		nested_level++;
+		PG_TRY();
+		{
+			if (prev_planner_hook)
+				result = prev_planner_hook(parse, cursorOptions, boundParams);
+			else
+				result = standard_planner(parse, cursorOptions, boundParams);
+			nested_level--;
+		}
+		PG_CATCH();
+		{
+			nested_level--;
+			PG_RE_THROW();
+		}
+		PG_END_TRY();
+
+		INSTR_TIME_SET_CURRENT(duration);
+		INSTR_TIME_SUBTRACT(duration, start);
+
+		pgss_store(NULL,
+				   parse->queryId,
+				   PGSS_PLAN,
+				   INSTR_TIME_GET_MILLISEC(duration),
+				   0,
+				   NULL,
+				   NULL,
+				   NULL);
+	}
+	else
+	{
+		if (prev_planner_hook)
+			result = prev_planner_hook(parse, cursorOptions, boundParams);
+		else
+			result = standard_planner(parse, cursorOptions, boundParams);
+	}
+
+	return result;
+}
+
 /*
  * ExecutorStart hook: start up tracking if needed
  */
@@ -930,9 +1096,11 @@ pgss_ExecutorEnd(QueryDesc *queryDesc)
 
 		pgss_store(queryDesc->sourceText,
 				   queryId,
+				   PGSS_EXEC,
 				   queryDesc->totaltime->total * 1000.0,		/* convert to msec */
 				   queryDesc->estate->es_processed,
 				   &queryDesc->totaltime->bufusage,
+				   &queryDesc->totaltime->walusage,
 				   NULL);
 	}
 
@@ -974,9 +1142,12 @@ pgss_ProcessUtility(Node *parsetree, const char *queryString,
 		uint64		rows;
 		BufferUsage bufusage_start,
 					bufusage;
+		WalUsage	walusage_start,
+					walusage;
 		uint32		queryId;
 
 		bufusage_start = pgBufferUsage;
+		walusage_start = pgWalUsage;
 		INSTR_TIME_SET_CURRENT(start);
 
 		nested_level++;
@@ -1041,14 +1212,20 @@ pgss_ProcessUtility(Node *parsetree, const char *queryString,
 		bufusage.blk_write_time = pgBufferUsage.blk_write_time;
 		INSTR_TIME_SUBTRACT(bufusage.blk_write_time, bufusage_start.blk_write_time);
 
+		/* calc differences of WAL counters. */
+		memset(&walusage, 0, sizeof(WalUsage));
+		WalUsageAccumDiff(&walusage, &pgWalUsage, &walusage_start);
+
 		/* For utility statements, we just hash the query string directly */
 		queryId = pgss_hash_string(queryString);
 
 		pgss_store(queryString,
 				   queryId,
+				   PGSS_EXEC,
 				   INSTR_TIME_GET_MILLISEC(duration),
 				   rows,
 				   &bufusage,
+				   &walusage,
 				   NULL);
 	}
 	else
@@ -1105,50 +1282,356 @@ pgss_hash_string(const char *str)
 	return hash_any((const unsigned char *) str, strlen(str));
 }
 
+/*
+ * Add the times of some executions (or plannings) to those of others: the
+ * counts are n_a and n_b, and the results go into the first set.  Means and
+ * sums of variances are combined with the pairwise form of Welford's method,
+ * so the second set may cover any number of measurements; see
+ * <http://www.johndcook.com/blog/standard_deviation/> and Chan, Golub and
+ * LeVeque, "Updating Formulae and a Pairwise Algorithm for Computing Sample
+ * Variances" (1979).
+ */
+static void
+add_times(int64 n_a, volatile double *total, volatile double *min,
+		  volatile double *max, volatile double *mean, volatile double *sum_var,
+		  int64 n_b, double total_b, double min_b, double max_b,
+		  double mean_b, double sum_var_b)
+{
+	if (n_b == 0)
+		return;
+
+	*total += total_b;
+	if (n_a == 0)
+	{
+		*min = min_b;
+		*max = max_b;
+		*mean = mean_b;
+		*sum_var = sum_var_b;
+	}
+	else
+	{
+		double		delta = mean_b - *mean;
+		double		n = (double) n_a + (double) n_b;
+
+		*mean += delta * n_b / n;
+		*sum_var += sum_var_b + delta * delta * n_a * n_b / n;
+
+		/* calculate min and max time */
+		if (*min > min_b)
+			*min = min_b;
+		if (*max < max_b)
+			*max = max_b;
+	}
+}
+
+/*
+ * Add the statistics in src to those in dst.
+ *
+ * If dst is in shared memory, the caller must hold the entry's spinlock.
+ */
+static void
+add_counters(volatile Counters *dst, const Counters *src)
+{
+	int			i;
+
+	/* "Unstick" entry if it was previously sticky */
+	if (dst->calls == 0 && src->calls > 0)
+		dst->usage = USAGE_INIT;
+
+	add_times(dst->calls, &dst->total_time, &dst->min_time, &dst->max_time,
+			  &dst->mean_time, &dst->sum_var_time,
+			  src->calls, src->total_time, src->min_time, src->max_time,
+			  src->mean_time, src->sum_var_time);
+	dst->calls += src->calls;
+	dst->rows += src->rows;
+	dst->shared_blks_hit += src->shared_blks_hit;
+	dst->shared_blks_read += src->shared_blks_read;
+	dst->shared_blks_dirtied += src->shared_blks_dirtied;
+	dst->shared_blks_written += src->shared_blks_written;
+	dst->local_blks_hit += src->local_blks_hit;
+	dst->local_blks_read += src->local_blks_read;
+	dst->local_blks_dirtied += src->local_blks_dirtied;
+	dst->local_blks_written += src->local_blks_written;
+	dst->temp_blks_read += src->temp_blks_read;
+	dst->temp_blks_written += src->temp_blks_written;
+	dst->blk_read_time += src->blk_read_time;
+	dst->blk_write_time += src->blk_write_time;
+	dst->wal_records += src->wal_records;
+	dst->wal_fpi += src->wal_fpi;
+	dst->wal_bytes += src->wal_bytes;
+	for (i = 0; i < PGSS_TIME_BUCKETS; i++)
+		dst->time_hist[i] += src->time_hist[i];
+	if (dst->last_call < src->last_call)
+		dst->last_call = src->last_call;
+
+	add_times(dst->plans, &dst->total_plan_time, &dst->min_plan_time,
+			  &dst->max_plan_time, &dst->mean_plan_time,
+			  &dst->sum_var_plan_time,
+			  src->plans, src->total_plan_time, src->min_plan_time,
+			  src->max_plan_time, src->mean_plan_time,
+			  src->sum_var_plan_time);
+	dst->plans += src->plans;
+
+	dst->usage += USAGE_EXEC(src->total_time) * src->calls;
+}
+
+/*
+ * Find the execution time histogram bucket for a time in msec.
+ */
+static int
+time_bucket(double time)
+{
+	double		bound = 0.1;
+	int			i;
+
+	for (i = 0; i < PGSS_TIME_BUCKETS - 1; i++)
+	{
+		if (time < bound)
+			break;
+		bound *= 10.0;
+	}
+	return i;
+}
+
+/*
+ * Acquire all the partition locks of the hashtable, in order.
+ */
+static void
+pgss_lock_all(LWLockMode mode)
+{
+	int			i;
+
+	for (i = 0; i < PGSS_NUM_PARTITIONS; i++)
+		LWLockAcquire(pgss->locks[i], mode);
+}
+
+/*
+ * Release all the partition locks of the hashtable.
+ */
+static void
+pgss_unlock_all(void)
+{
+	int			i;
+
+	for (i = PGSS_NUM_PARTITIONS - 1; i >= 0; i--)
+		LWLockRelease(pgss->locks[i]);
+}
+
+/*
+ * Add the statistics accumulated by this backend to the shared entries.
+ *
+ * Statistics of entries that have been deallocated meanwhile are lost.  We
+ * can't recreate the entries, since we don't have their query texts.
+ */
+static void
+pgss_flush_pending(void)
+{
+	HASH_SEQ_STATUS hash_seq;
+	pgssPending *pending;
+
+	if (!pgss_pending)
+		return;
+
+	hash_seq_init(&hash_seq, pgss_pending);
+	while ((pending = hash_seq_search(&hash_seq)) != NULL)
+	{
+		uint32		hashcode = get_hash_value(pgss_hash, &pending->key);
+		LWLock	   *partlock = PGSS_PARTITION_LOCK(hashcode);
+		pgssEntry  *entry;
+
+		LWLockAcquire(partlock, LW_SHARED);
+		entry = (pgssEntry *) hash_search_with_hash_value(pgss_hash,
+														  &pending->key,
+														  hashcode,
+														  HASH_FIND, NULL);
+		if (entry)
+		{
+			volatile pgssEntry *e = (volatile pgssEntry *) entry;
+
+			SpinLockAcquire(&e->mutex);
+			add_counters(&e->counters, &pending->counters);
+			SpinLockRelease(&e->mutex);
+		}
+		LWLockRelease(partlock);
+	}
+
+	hash_destroy(pgss_pending);
+	pgss_pending = NULL;
+}
+
+/*
+ * Flush this backend's accumulated statistics when it exits normally.
+ */
+static void
+pgss_backend_shutdown(int code, Datum arg)
+{
+	/* Don't bother after an error; we might even hold one of our locks */
+	if (code != 0)
+		return;
+
+	if (pgss && pgss_hash)
+		pgss_flush_pending();
+}
+
+/*
+ * Start accumulating the statistics of an entry in this backend.
+ */
+static void
+pgss_remember_pending(pgssHashKey *key, TimestampTz now)
+{
+	pgssPending *pending;
+	bool		found;
+
+	if (!pgss_pending)
+	{
+		HASHCTL		info;
+
+		memset(&info, 0, sizeof(info));
+		info.keysize = sizeof(pgssHashKey);
+		info.entrysize = sizeof(pgssPending);
+		pgss_pending = hash_create("pg_stat_statements pending", 64,
+								   &info, HASH_ELEM | HASH_BLOBS);
+		pgss_last_flush = now;
+
+		if (!pgss_shutdown_registered)
+		{
+			before_shmem_exit(pgss_backend_shutdown, (Datum) 0);
+			pgss_shutdown_registered = true;
+		}
+	}
+
+	pending = (pgssPending *) hash_search(pgss_pending, key, HASH_ENTER,
+										  &found);
+	if (!found)
+		memset(&pending->counters, 0, sizeof(Counters));
+}
+
 /*
  * Store some statistics for a statement.
  *
  * If jstate is not NULL then we're trying to create an entry for which
  * we have no statistics as yet; we just want to record the normalized
- * query string.  total_time, rows, bufusage are ignored in this case.
+ * query string.  total_time, rows, bufusage, walusage are ignored in this
+ * case.
+ *
+ * If kind is PGSS_PLAN, total_time is the planning time, and the other
+ * statistics are ignored.  query is NULL in that case, since the planner
+ * doesn't know the query text, so nothing is recorded unless the entry
+ * exists already.
+ *
+ * If pg_stat_statements.flush_interval is set, the statistics of an entry
+ * are added to the shared hashtable directly only the first time in each
+ * interval; after that, they are accumulated in this backend, and added to
+ * the shared hashtable once the interval has passed.
  */
 static void
 pgss_store(const char *query, uint32 queryId,
-		   double total_time, uint64 rows,
+		   pgssStoreKind kind, double total_time, uint64 rows,
 		   const BufferUsage *bufusage,
+		   const WalUsage *walusage,
 		   pgssJumbleState *jstate)
 {
 	pgssHashKey key;
+	uint32		hashcode;
+	LWLock	   *partlock;
+	bool		all_locked = false;
 	pgssEntry  *entry;
+	Counters	delta;
 	char	   *norm_query = NULL;
 	int			encoding = GetDatabaseEncoding();
 	int			query_len;
+	TimestampTz now = 0;
 
-	Assert(query != NULL);
+	Assert(query != NULL || kind == PGSS_PLAN);
 
 	/* Safety check... */
 	if (!pgss || !pgss_hash)
 		return;
 
-	query_len = strlen(query);
+	query_len = query ? strlen(query) : 0;
 
 	/* Set up key for hashtable search */
 	key.userid = GetUserId();
 	key.dbid = MyDatabaseId;
 	key.queryid = queryId;
 
-	/* Lookup the hash table entry with shared lock. */
-	LWLockAcquire(pgss->lock, LW_SHARED);
+	/* Work out the statistics to add before taking any lock */
+	memset(&delta, 0, sizeof(Counters));
+	if (kind == PGSS_PLAN)
+	{
+		delta.plans = 1;
+		delta.total_plan_time = total_time;
+		delta.min_plan_time = total_time;
+		delta.max_plan_time = total_time;
+		delta.mean_plan_time = total_time;
+	}
+	else if (!jstate)
+	{
+		now = GetCurrentTimestamp();
+
+		delta.calls = 1;
+		delta.total_time = total_time;
+		delta.min_time = total_time;
+		delta.max_time = total_time;
+		delta.mean_time = total_time;
+		delta.rows = rows;
+		delta.shared_blks_hit = bufusage->shared_blks_hit;
+		delta.shared_blks_read = bufusage->shared_blks_read;
+		delta.shared_blks_dirtied = bufusage->shared_blks_dirtied;
+		delta.shared_blks_written = bufusage->shared_blks_written;
+		delta.local_blks_hit = bufusage->local_blks_hit;
+		delta.local_blks_read = bufusage->local_blks_read;
+		delta.local_blks_dirtied = bufusage->local_blks_dirtied;
+		delta.local_blks_written = bufusage->local_blks_written;
+		delta.temp_blks_read = bufusage->temp_blks_read;
+		delta.temp_blks_written = bufusage->temp_blks_written;
+		delta.blk_read_time = INSTR_TIME_GET_MILLISEC(bufusage->blk_read_time);
+		delta.blk_write_time = INSTR_TIME_GET_MILLISEC(bufusage->blk_write_time);
+		delta.wal_records = walusage->wal_records;
+		delta.wal_fpi = walusage->wal_fpi;
+		delta.wal_bytes = walusage->wal_bytes;
+		delta.time_hist[time_bucket(total_time)] = 1;
+		delta.last_call = now;
+	}
 
-	entry = (pgssEntry *) hash_search(pgss_hash, &key, HASH_FIND, NULL);
+	/* If we're accumulating this entry's statistics locally, that's all */
+	if (!jstate && pgss_pending)
+	{
+		pgssPending *pending;
+
+		pending = (pgssPending *) hash_search(pgss_pending, &key,
+											  HASH_FIND, NULL);
+		if (pending)
+		{
+			add_counters(&pending->counters, &delta);
+			if (kind == PGSS_EXEC &&
+				TimestampDifferenceExceeds(pgss_last_flush, now,
+										   pgss_flush_interval))
+				pgss_flush_pending();
+			return;
+		}
+	}
+
+	/* Lookup the hash table entry with shared lock on its partition. */
+	hashcode = get_hash_value(pgss_hash, &key);
+	partlock = PGSS_PARTITION_LOCK(hashcode);
+	LWLockAcquire(partlock, LW_SHARED);
+
+	entry = (pgssEntry *) hash_search_with_hash_value(pgss_hash, &key,
+													  hashcode,
+													  HASH_FIND, NULL);
 
 	/* Create new entry, if not present */
 	if (!entry)
 	{
+		const char *text;
 		Size		query_offset;
 		int			gc_count;
 		bool		stored;
-		bool		do_gc;
+
+		/* We can't create an entry without a query text */
+		if (!query)
+			goto done;
 
 		/*
 		 * Create a new, normalized query string if caller asked.  We don't
@@ -1159,50 +1642,70 @@ pgss_store(const char *query, uint32 queryId,
 		 */
 		if (jstate)
 		{
-			LWLockRelease(pgss->lock);
+			LWLockRelease(partlock);
 			norm_query = generate_normalized_query(jstate, query,
 												   &query_len,
 												   encoding);
-			LWLockAcquire(pgss->lock, LW_SHARED);
+			LWLockAcquire(partlock, LW_SHARED);
 		}
+		text = norm_query ? norm_query : query;
 
-		/* Append new query text to file with only shared lock held */
-		stored = qtext_store(norm_query ? norm_query : query, query_len,
-							 &query_offset, &gc_count);
+		/* Append new query text with only shared lock held */
+		stored = qtext_store(text, query_len, &query_offset, &gc_count);
 
 		/*
-		 * Determine whether we need to garbage collect external query texts
-		 * while the shared lock is still held.  This micro-optimization
-		 * avoids taking the time to decide this while holding exclusive lock.
+		 * Need exclusive lock to make a new hashtable entry - promote.  The
+		 * lock of the entry's partition is enough, unless we have to make
+		 * room in the hashtable or in the text area, which needs all of
+		 * them.
 		 */
-		do_gc = need_gc_qtexts();
-
-		/* Need exclusive lock to make a new hashtable entry - promote */
-		LWLockRelease(pgss->lock);
-		LWLockAcquire(pgss->lock, LW_EXCLUSIVE);
+		LWLockRelease(partlock);
+		if (stored && hash_get_num_entries(pgss_hash) < pgss_max)
+			LWLockAcquire(partlock, LW_EXCLUSIVE);
+		else
+		{
+			pgss_lock_all(LW_EXCLUSIVE);
+			all_locked = true;
+		}
 
 		/*
 		 * A garbage collection may have occurred while we weren't holding the
 		 * lock.  In the unlikely event that this happens, the query text we
-		 * stored above will have been garbage collected, so write it again.
-		 * This should be infrequent enough that doing it while holding
-		 * exclusive lock isn't a performance problem.
+		 * stored above will have been garbage collected, so store it again.
+		 * The same goes if the text area was full; then we have to make
+		 * room, which needs all the locks anyway.
 		 */
 		if (!stored || pgss->gc_count != gc_count)
-			stored = qtext_store(norm_query ? norm_query : query, query_len,
-								 &query_offset, NULL);
+		{
+			stored = qtext_store(text, query_len, &query_offset, &gc_count);
+			if (!stored && !all_locked)
+			{
+				LWLockRelease(partlock);
+				pgss_lock_all(LW_EXCLUSIVE);
+				all_locked = true;
+			}
+			if (!stored)
+				stored = qtext_store_exclusive(text, query_len,
+											   &query_offset);
+		}
 
-		/* If we failed to write to the text file, give up */
+		/* If the text doesn't fit at all, track the statement without it */
 		if (!stored)
-			goto done;
+		{
+			query_offset = 0;
+			query_len = -1;
+		}
 
-		/* OK to create a new hashtable entry */
-		entry = entry_alloc(&key, query_offset, query_len, encoding,
-							jstate != NULL);
+		/* Make space if needed, and if we can */
+		if (all_locked)
+		{
+			while (hash_get_num_entries(pgss_hash) >= pgss_max)
+				entry_dealloc();
+		}
 
-		/* If needed, perform garbage collection while exclusive lock held */
-		if (do_gc)
-			gc_qtexts();
+		/* OK to create a new hashtable entry */
+		entry = entry_alloc(&key, hashcode, query_offset, query_len,
+							encoding, jstate != NULL);
 	}
 
 	/* Increment the counts, except when jstate is not NULL */
@@ -1215,62 +1718,23 @@ pgss_store(const char *query, uint32 queryId,
 		volatile pgssEntry *e = (volatile pgssEntry *) entry;
 
 		SpinLockAcquire(&e->mutex);
-
-		/* "Unstick" entry if it was previously sticky */
-		if (e->counters.calls == 0)
-			e->counters.usage = USAGE_INIT;
-
-		e->counters.calls += 1;
-		e->counters.total_time += total_time;
-		if (e->counters.calls == 1)
-		{
-			e->counters.min_time = total_time;
-			e->counters.max_time = total_time;
-			e->counters.mean_time = total_time;
-		}
-		else
-		{
-			/*
-			 * Welford's method for accurately computing variance. See
-			 * <http://www.johndcook.com/blog/standard_deviation/>
-			 */
-			double		old_mean = e->counters.mean_time;
-
-			e->counters.mean_time +=
-				(total_time - old_mean) / e->counters.calls;
-			e->counters.sum_var_time +=
-				(total_time - old_mean) * (total_time - e->counters.mean_time);
-
-			/* calculate min and max time */
-			if (e->counters.min_time > total_time)
-				e->counters.min_time = total_time;
-			if (e->counters.max_time < total_time)
-				e->counters.max_time = total_time;
-		}
-		e->counters.rows += rows;
-		e->counters.shared_blks_hit += bufusage->shared_blks_hit;
-		e->counters.shared_blks_read += bufusage->shared_blks_read;
-		e->counters.shared_blks_dirtied += bufusage->shared_blks_dirtied;
-		e->counters.shared_blks_written += bufusage->shared_blks_written;
-		e->counters.local_blks_hit += bufusage->local_blks_hit;
-		e->counters.local_blks_read += bufusage->local_blks_read;
-		e->counters.local_blks_dirtied += bufusage->local_blks_dirtied;
-		e->counters.local_blks_written += bufusage->local_blks_written;
-		e->counters.temp_blks_read += bufusage->temp_blks_read;
-		e->counters.temp_blks_written += bufusage->temp_blks_written;
-		e->counters.blk_read_time += INSTR_TIME_GET_MILLISEC(bufusage->blk_read_time);
-		e->counters.blk_write_time += INSTR_TIME_GET_MILLISEC(bufusage->blk_write_time);
-		e->counters.usage += USAGE_EXEC(total_time);
-
+		add_counters(&e->counters, &delta);
 		SpinLockRelease(&e->mutex);
 	}
 
 done:
-	LWLockRelease(pgss->lock);
+	if (all_locked)
+		pgss_unlock_all();
+	else
+		LWLockRelease(partlock);
 
 	/* We postpone this clean-up until we're out of the lock */
 	if (norm_query)
 		pfree(norm_query);
+
+	/* Accumulate further statistics of this entry locally, if asked to */
+	if (entry && !jstate && kind == PGSS_EXEC && pgss_flush_interval > 0)
+		pgss_remember_pending(&key, now);
 }
 
 /*
@@ -1292,7 +1756,9 @@ pg_stat_statements_reset(PG_FUNCTION_ARGS)
 #define PG_STAT_STATEMENTS_COLS_V1_1	18
 #define PG_STAT_STATEMENTS_COLS_V1_2	19
 #define PG_STAT_STATEMENTS_COLS_V1_3	23
-#define PG_STAT_STATEMENTS_COLS			23		/* maximum of above */
+#define PG_STAT_STATEMENTS_COLS_V1_4	26
+#define PG_STAT_STATEMENTS_COLS_V1_5	35
+#define PG_STAT_STATEMENTS_COLS			35		/* maximum of above */
 
 /*
  * Retrieve statement statistics.
@@ -1304,12 +1770,33 @@ pg_stat_statements_reset(PG_FUNCTION_ARGS)
  * expected API version is identified by embedding it in the C name of the
  * function.  Unfortunately we weren't bright enough to do that for 1.1.
  */
+Datum
+pg_stat_statements_1_5(PG_FUNCTION_ARGS)
+{
+	bool		showtext = PG_GETARG_BOOL(0);
+	TimestampTz changed_since = PG_GETARG_TIMESTAMPTZ(1);
+
+	pg_stat_statements_internal(fcinfo, PGSS_V1_5, showtext, changed_since);
+
+	return (Datum) 0;
+}
+
+Datum
+pg_stat_statements_1_4(PG_FUNCTION_ARGS)
+{
+	bool		showtext = PG_GETARG_BOOL(0);
+
+	pg_stat_statements_internal(fcinfo, PGSS_V1_4, showtext, DT_NOBEGIN);
+
+	return (Datum) 0;
+}
+
 Datum
 pg_stat_statements_1_3(PG_FUNCTION_ARGS)
 {
 	bool		showtext = PG_GETARG_BOOL(0);
 
-	pg_stat_statements_internal(fcinfo, PGSS_V1_3, showtext);
+	pg_stat_statements_internal(fcinfo, PGSS_V1_3, showtext, DT_NOBEGIN);
 
 	return (Datum) 0;
 }
@@ -1319,7 +1806,7 @@ pg_stat_statements_1_2(PG_FUNCTION_ARGS)
 {
 	bool		showtext = PG_GETARG_BOOL(0);
 
-	pg_stat_statements_internal(fcinfo, PGSS_V1_2, showtext);
+	pg_stat_statements_internal(fcinfo, PGSS_V1_2, showtext, DT_NOBEGIN);
 
 	return (Datum) 0;
 }
@@ -1332,16 +1819,23 @@ Datum
 pg_stat_statements(PG_FUNCTION_ARGS)
 {
 	/* If it's really API 1.1, we'll figure that out below */
-	pg_stat_statements_internal(fcinfo, PGSS_V1_0, true);
+	pg_stat_statements_internal(fcinfo, PGSS_V1_0, true, DT_NOBEGIN);
 
 	return (Datum) 0;
 }
 
-/* Common code for all versions of pg_stat_statements() */
+/*
+ * Common code for all versions of pg_stat_statements()
+ *
+ * Only entries executed at or after changed_since are returned, which lets
+ * monitoring tools that poll the view cheaply fetch just what has changed
+ * since they last looked.
+ */
 static void
 pg_stat_statements_internal(FunctionCallInfo fcinfo,
 							pgssVersion api_version,
-							bool showtext)
+							bool showtext,
+							TimestampTz changed_since)
 {
 	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
 	TupleDesc	tupdesc;
@@ -1350,10 +1844,6 @@ pg_stat_statements_internal(FunctionCallInfo fcinfo,
 	MemoryContext oldcontext;
 	Oid			userid = GetUserId();
 	bool		is_superuser = superuser();
-	char	   *qbuffer = NULL;
-	Size		qbuffer_size = 0;
-	Size		extent = 0;
-	int			gc_count = 0;
 	HASH_SEQ_STATUS hash_seq;
 	pgssEntry  *entry;
 
@@ -1407,6 +1897,14 @@ pg_stat_statements_internal(FunctionCallInfo fcinfo,
 			if (api_version != PGSS_V1_3)
 				elog(ERROR, "incorrect number of output arguments");
 			break;
+		case PG_STAT_STATEMENTS_COLS_V1_4:
+			if (api_version != PGSS_V1_4)
+				elog(ERROR, "incorrect number of output arguments");
+			break;
+		case PG_STAT_STATEMENTS_COLS_V1_5:
+			if (api_version != PGSS_V1_5)
+				elog(ERROR, "incorrect number of output arguments");
+			break;
 		default:
 			elog(ERROR, "incorrect number of output arguments");
 	}
@@ -1418,70 +1916,19 @@ pg_stat_statements_internal(FunctionCallInfo fcinfo,
 
 	MemoryContextSwitchTo(oldcontext);
 
-	/*
-	 * We'd like to load the query text file (if needed) while not holding any
-	 * lock on pgss->lock.  In the worst case we'll have to do this again
-	 * after we have the lock, but it's unlikely enough to make this a win
-	 * despite occasional duplicated work.  We need to reload if anybody
-	 * writes to the file (either a retail qtext_store(), or a garbage
-	 * collection) between this point and where we've gotten shared lock.  If
-	 * a qtext_store is actually in progress when we look, we might as well
-	 * skip the speculative load entirely.
-	 */
-	if (showtext)
-	{
-		int			n_writers;
-
-		/* Take the mutex so we can examine variables */
-		{
-			volatile pgssSharedState *s = (volatile pgssSharedState *) pgss;
-
-			SpinLockAcquire(&s->mutex);
-			extent = s->extent;
-			n_writers = s->n_writers;
-			gc_count = s->gc_count;
-			SpinLockRelease(&s->mutex);
-		}
-
-		/* No point in loading file now if there are active writers */
-		if (n_writers == 0)
-			qbuffer = qtext_load_file(&qbuffer_size);
-	}
+	/* Let the caller see its own statistics, at least */
+	pgss_flush_pending();
 
 	/*
-	 * Get shared lock, load or reload the query text file if we must, and
-	 * iterate over the hashtable entries.
+	 * Get shared locks and iterate over the hashtable entries.  The query
+	 * texts can be read straight from the text area while we hold them.
 	 *
-	 * With a large hash table, we might be holding the lock rather longer
+	 * With a large hash table, we might be holding the locks rather longer
 	 * than one could wish.  However, this only blocks creation of new hash
 	 * table entries, and the larger the hash table the less likely that is to
-	 * be needed.  So we can hope this is okay.  Perhaps someday we'll decide
-	 * we need to partition the hash table to limit the time spent holding any
-	 * one lock.
+	 * be needed.  So we can hope this is okay.
 	 */
-	LWLockAcquire(pgss->lock, LW_SHARED);
-
-	if (showtext)
-	{
-		/*
-		 * Here it is safe to examine extent and gc_count without taking the
-		 * mutex.  Note that although other processes might change
-		 * pgss->extent just after we look at it, the strings they then write
-		 * into the file cannot yet be referenced in the hashtable, so we
-		 * don't care whether we see them or not.
-		 *
-		 * If qtext_load_file fails, we just press on; we'll return NULL for
-		 * every query text.
-		 */
-		if (qbuffer == NULL ||
-			pgss->extent != extent ||
-			pgss->gc_count != gc_count)
-		{
-			if (qbuffer)
-				free(qbuffer);
-			qbuffer = qtext_load_file(&qbuffer_size);
-		}
-	}
+	pgss_lock_all(LW_SHARED);
 
 	hash_seq_init(&hash_seq, pgss_hash);
 	while ((entry = hash_seq_search(&hash_seq)) != NULL)
@@ -1493,6 +1940,23 @@ pg_stat_statements_internal(FunctionCallInfo fcinfo,
 		double		stddev;
 		int64		queryid = entry->key.queryid;
 
+		/* copy counters to a local variable to keep locking time short */
+		{
+			volatile pgssEntry *e = (volatile pgssEntry *) entry;
+
+			SpinLockAcquire(&e->mutex);
+			tmp = e->counters;
+			SpinLockRelease(&e->mutex);
+		}
+
+		/* Skip entry if unexecuted (ie, it's a pending "sticky" entry) */
+		if (tmp.calls == 0)
+			continue;
+
+		/* Skip entry if the caller has seen its latest execution already */
+		if (tmp.last_call < changed_since)
+			continue;
+
 		memset(values, 0, sizeof(values));
 		memset(nulls, 0, sizeof(nulls));
 
@@ -1507,9 +1971,7 @@ pg_stat_statements_internal(FunctionCallInfo fcinfo,
 			if (showtext)
 			{
 				char	   *qstr = qtext_fetch(entry->query_offset,
-											   entry->query_len,
-											   qbuffer,
-											   qbuffer_size);
+											   entry->query_len);
 
 				if (qstr)
 				{
@@ -1552,19 +2014,6 @@ pg_stat_statements_internal(FunctionCallInfo fcinfo,
 				nulls[i++] = true;
 		}
 
-		/* copy counters to a local variable to keep locking time short */
-		{
-			volatile pgssEntry *e = (volatile pgssEntry *) entry;
-
-			SpinLockAcquire(&e->mutex);
-			tmp = e->counters;
-			SpinLockRelease(&e->mutex);
-		}
-
-		/* Skip entry if unexecuted (ie, it's a pending "sticky" entry) */
-		if (tmp.calls == 0)
-			continue;
-
 		values[i++] = Int64GetDatumFast(tmp.calls);
 		values[i++] = Float8GetDatumFast(tmp.total_time);
 		if (api_version >= PGSS_V1_3)
@@ -1603,25 +2052,107 @@ pg_stat_statements_internal(FunctionCallInfo fcinfo,
 			values[i++] = Float8GetDatumFast(tmp.blk_read_time);
 			values[i++] = Float8GetDatumFast(tmp.blk_write_time);
 		}
+		if (api_version >= PGSS_V1_4)
+		{
+			char		buf[256];
+			Datum		wal_bytes;
+
+			values[i++] = Int64GetDatumFast(tmp.wal_records);
+			values[i++] = Int64GetDatumFast(tmp.wal_fpi);
+
+			/* Convert to numeric, since the value might not fit in bigint */
+			snprintf(buf, sizeof buf, UINT64_FORMAT, tmp.wal_bytes);
+			wal_bytes = DirectFunctionCall3(numeric_in,
+											CStringGetDatum(buf),
+											ObjectIdGetDatum(0),
+											Int32GetDatum(-1));
+			values[i++] = wal_bytes;
+		}
+		if (api_version >= PGSS_V1_5)
+		{
+			Datum		hist[PGSS_TIME_BUCKETS];
+			int			j;
+
+			values[i++] = Int64GetDatumFast(tmp.plans);
+			values[i++] = Float8GetDatumFast(tmp.total_plan_time);
+			values[i++] = Float8GetDatumFast(tmp.min_plan_time);
+			values[i++] = Float8GetDatumFast(tmp.max_plan_time);
+			values[i++] = Float8GetDatumFast(tmp.mean_plan_time);
+			if (tmp.plans > 1)
+				stddev = sqrt(tmp.sum_var_plan_time / tmp.plans);
+			else
+				stddev = 0.0;
+			values[i++] = Float8GetDatumFast(stddev);
+
+			for (j = 0; j < PGSS_TIME_BUCKETS; j++)
+				hist[j] = Int64GetDatum(tmp.time_hist[j]);
+			values[i++] = PointerGetDatum(construct_array(hist,
+														  PGSS_TIME_BUCKETS,
+														  INT8OID,
+														  sizeof(int64),
+														  FLOAT8PASSBYVAL,
+														  'd'));
+
+			values[i++] = TimestampTzGetDatum(entry->stats_since);
+			values[i++] = TimestampTzGetDatum(tmp.last_call);
+		}
 
 		Assert(i == (api_version == PGSS_V1_0 ? PG_STAT_STATEMENTS_COLS_V1_0 :
 					 api_version == PGSS_V1_1 ? PG_STAT_STATEMENTS_COLS_V1_1 :
 					 api_version == PGSS_V1_2 ? PG_STAT_STATEMENTS_COLS_V1_2 :
 					 api_version == PGSS_V1_3 ? PG_STAT_STATEMENTS_COLS_V1_3 :
+					 api_version == PGSS_V1_4 ? PG_STAT_STATEMENTS_COLS_V1_4 :
+					 api_version == PGSS_V1_5 ? PG_STAT_STATEMENTS_COLS_V1_5 :
 					 -1 /* fail if you forget to update this assert */ ));
 
 		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
 	}
 
 	/* clean up and return the tuplestore */
-	LWLockRelease(pgss->lock);
-
-	if (qbuffer)
-		free(qbuffer);
+	pgss_unlock_all();
 
 	tuplestore_donestoring(tupstore);
 }
 
+/* Number of output arguments (columns) for pg_stat_statements_info */
+#define PG_STAT_STATEMENTS_INFO_COLS	2
+
+/*
+ * Return statistics of pg_stat_statements as a whole.
+ *
+ * Monitoring tools that compute deltas of the counters can use stats_reset
+ * to tell when all entries were reset, and dealloc to tell whether entries
+ * may have been evicted and recreated, since they last looked.
+ */
+Datum
+pg_stat_statements_info(PG_FUNCTION_ARGS)
+{
+	pgssGlobalStats stats;
+	TupleDesc	tupdesc;
+	Datum		values[PG_STAT_STATEMENTS_INFO_COLS];
+	bool		nulls[PG_STAT_STATEMENTS_INFO_COLS];
+
+	if (!pgss || !pgss_hash)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("pg_stat_statements must be loaded via shared_preload_libraries")));
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	/* Any one partition lock keeps the stats from changing */
+	LWLockAcquire(pgss->locks[0], LW_SHARED);
+	stats = pgss->stats;
+	LWLockRelease(pgss->locks[0]);
+
+	memset(nulls, 0, sizeof(nulls));
+	values[0] = Int64GetDatum(stats.dealloc);
+	values[1] = TimestampTzGetDatum(stats.stats_reset);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
+
 /*
  * Estimate shared memory space needed.
  */
@@ -1632,13 +2163,15 @@ pgss_memsize(void)
 
 	size = MAXALIGN(sizeof(pgssSharedState));
 	size = add_size(size, hash_estimate_size(pgss_max, sizeof(pgssEntry)));
+	size = add_size(size, (Size) pgss_query_texts_size * 1024);
 
 	return size;
 }
 
 /*
  * Allocate a new hashtable entry.
- * caller must hold an exclusive lock on pgss->lock
+ * caller must hold an exclusive lock on the partition lock for hashcode,
+ * and must have made room in the hashtable if needed
  *
  * "query" need not be null-terminated; we rely on query_len instead
  *
@@ -1654,18 +2187,16 @@ pgss_memsize(void)
  * have made the entry while we waited to get exclusive lock.
  */
 static pgssEntry *
-entry_alloc(pgssHashKey *key, Size query_offset, int query_len, int encoding,
-			bool sticky)
+entry_alloc(pgssHashKey *key, uint32 hashcode, Size query_offset,
+			int query_len, int encoding, bool sticky)
 {
 	pgssEntry  *entry;
 	bool		found;
 
-	/* Make space if needed */
-	while (hash_get_num_entries(pgss_hash) >= pgss_max)
-		entry_dealloc();
-
 	/* Find or create an entry with desired hash code */
-	entry = (pgssEntry *) hash_search(pgss_hash, key, HASH_ENTER, &found);
+	entry = (pgssEntry *) hash_search_with_hash_value(pgss_hash, key,
+													  hashcode, HASH_ENTER,
+													  &found);
 
 	if (!found)
 	{
@@ -1677,8 +2208,8 @@ entry_alloc(pgssHashKey *key, Size query_offset, int query_len, int encoding,
 		entry->counters.usage = sticky ? pgss->cur_median_usage : USAGE_INIT;
 		/* re-initialize the mutex each time ... we assume no one using it */
 		SpinLockInit(&entry->mutex);
+		entry->stats_since = GetCurrentTimestamp();
 		/* ... and don't forget the query text metadata */
-		Assert(query_len >= 0);
 		entry->query_offset = query_offset;
 		entry->query_len = query_len;
 		entry->encoding = encoding;
@@ -1706,7 +2237,7 @@ entry_cmp(const void *lhs, const void *rhs)
 
 /*
  * Deallocate least used entries.
- * Caller must hold an exclusive lock on pgss->lock.
+ * Caller must hold all the partition locks exclusively.
  */
 static void
 entry_dealloc(void)
@@ -1716,7 +2247,6 @@ entry_dealloc(void)
 	pgssEntry  *entry;
 	int			nvictims;
 	int			i;
-	Size		totlen = 0;
 
 	/*
 	 * Sort entries by usage and deallocate USAGE_DEALLOC_PERCENT of them.
@@ -1736,8 +2266,6 @@ entry_dealloc(void)
 			entry->counters.usage *= STICKY_DECREASE_FACTOR;
 		else
 			entry->counters.usage *= USAGE_DECREASE_FACTOR;
-		/* Accumulate total size, too. */
-		totlen += entry->query_len + 1;
 	}
 
 	qsort(entries, i, sizeof(pgssEntry *), entry_cmp);
@@ -1746,8 +2274,6 @@ entry_dealloc(void)
 	{
 		/* Record the (approximate) median usage */
 		pgss->cur_median_usage = entries[i / 2]->counters.usage;
-		/* Record the mean query length */
-		pgss->mean_query_len = totlen / i;
 	}
 
 	nvictims = Max(10, i * USAGE_DEALLOC_PERCENT / 100);
@@ -1759,304 +2285,203 @@ entry_dealloc(void)
 	}
 
 	pfree(entries);
+
+	pgss->stats.dealloc += 1;
 }
 
 /*
- * Given a null-terminated string, allocate a new entry in the external query
- * text file and store the string there.
+ * Given a null-terminated string, copy it into free space at the end of the
+ * query text area.
  *
  * Although we could compute the string length via strlen(), callers already
  * have it handy, so we require them to pass it too.
  *
- * If successful, returns true, and stores the new entry's offset in the file
- * into *query_offset.  Also, if gc_count isn't NULL, *gc_count is set to the
+ * If successful, returns true, and stores the text's offset in the area into
+ * *query_offset.  Also, if gc_count isn't NULL, *gc_count is set to the
  * number of garbage collections that have occurred so far.
  *
- * On failure, returns false.
+ * If there isn't room for the string, returns false.  The caller can then
+ * make room with qtext_store_exclusive().
  *
- * At least a shared lock on pgss->lock must be held by the caller, so as
- * to prevent a concurrent garbage collection.  Share-lock-holding callers
- * should pass a gc_count pointer to obtain the number of garbage collections,
- * so that they can recheck the count after obtaining exclusive lock to
- * detect whether a garbage collection occurred (and removed this entry).
+ * At least a shared lock on one of the partition locks must be held by the
+ * caller, so as to prevent a concurrent garbage collection.  Callers that
+ * will release that lock before creating the entry should pass a gc_count
+ * pointer to obtain the number of garbage collections, so that they can
+ * recheck the count after obtaining exclusive lock to detect whether a
+ * garbage collection occurred (and removed this text).
  */
 static bool
 qtext_store(const char *query, int query_len,
 			Size *query_offset, int *gc_count)
 {
 	Size		off;
-	int			fd;
+	bool		fits;
 
 	/*
-	 * We use a spinlock to protect extent/n_writers/gc_count, so that
-	 * multiple processes may execute this function concurrently.
+	 * We use a spinlock to protect extent/gc_count, so that multiple
+	 * processes may execute this function concurrently.
 	 */
 	{
 		volatile pgssSharedState *s = (volatile pgssSharedState *) pgss;
 
 		SpinLockAcquire(&s->mutex);
 		off = s->extent;
-		s->extent += query_len + 1;
-		s->n_writers++;
+		fits = (off + query_len + 1 <= s->qtext_size);
+		if (fits)
+			s->extent += query_len + 1;
 		if (gc_count)
 			*gc_count = s->gc_count;
 		SpinLockRelease(&s->mutex);
 	}
 
-	*query_offset = off;
-
-	/* Now write the data into the successfully-reserved part of the file */
-	fd = OpenTransientFile(PGSS_TEXT_FILE, O_RDWR | O_CREAT | PG_BINARY,
-						   S_IRUSR | S_IWUSR);
-	if (fd < 0)
-		goto error;
-
-	if (lseek(fd, off, SEEK_SET) != off)
-		goto error;
-
-	if (write(fd, query, query_len + 1) != query_len + 1)
-		goto error;
-
-	CloseTransientFile(fd);
-
-	/* Mark our write complete */
-	{
-		volatile pgssSharedState *s = (volatile pgssSharedState *) pgss;
+	if (!fits)
+		return false;
 
-		SpinLockAcquire(&s->mutex);
-		s->n_writers--;
-		SpinLockRelease(&s->mutex);
-	}
+	/* Now copy the string into the successfully-reserved space */
+	memcpy(pgss_qtexts + off, query, query_len + 1);
+	*query_offset = off;
 
 	return true;
-
-error:
-	ereport(LOG,
-			(errcode_for_file_access(),
-			 errmsg("could not write pg_stat_statement file \"%s\": %m",
-					PGSS_TEXT_FILE)));
-
-	if (fd >= 0)
-		CloseTransientFile(fd);
-
-	/* Mark our write complete */
-	{
-		volatile pgssSharedState *s = (volatile pgssSharedState *) pgss;
-
-		SpinLockAcquire(&s->mutex);
-		s->n_writers--;
-		SpinLockRelease(&s->mutex);
-	}
-
-	return false;
 }
 
 /*
- * Read the external query text file into a malloc'd buffer.
- *
- * Returns NULL (without throwing an error) if unable to read, eg
- * file not there or insufficient memory.
+ * Like qtext_store(), but if there isn't room for the string, garbage-collect
+ * the query text area, and if that doesn't free enough space, deallocate
+ * entries until it does.
  *
- * On success, the buffer size is also returned into *buffer_size.
+ * Returns false only if the string is too long to be worth making room for,
+ * that is longer than a quarter of the whole area.
  *
- * This can be called without any lock on pgss->lock, but in that case
- * the caller is responsible for verifying that the result is sane.
+ * The caller must hold all the partition locks exclusively.
  */
-static char *
-qtext_load_file(Size *buffer_size)
+static bool
+qtext_store_exclusive(const char *query, int query_len, Size *query_offset)
 {
-	char	   *buf;
-	int			fd;
-	struct stat stat;
+	if (qtext_store(query, query_len, query_offset, NULL))
+		return true;
 
-	fd = OpenTransientFile(PGSS_TEXT_FILE, O_RDONLY | PG_BINARY, 0);
-	if (fd < 0)
-	{
-		if (errno != ENOENT)
-			ereport(LOG,
-					(errcode_for_file_access(),
-				   errmsg("could not read pg_stat_statement file \"%s\": %m",
-						  PGSS_TEXT_FILE)));
-		return NULL;
-	}
-
-	/* Get file length */
-	if (fstat(fd, &stat))
-	{
-		ereport(LOG,
-				(errcode_for_file_access(),
-				 errmsg("could not stat pg_stat_statement file \"%s\": %m",
-						PGSS_TEXT_FILE)));
-		CloseTransientFile(fd);
-		return NULL;
-	}
-
-	/* Allocate buffer; beware that off_t might be wider than size_t */
-	if (stat.st_size <= MaxAllocSize)
-		buf = (char *) malloc(stat.st_size);
-	else
-		buf = NULL;
-	if (buf == NULL)
-	{
-		ereport(LOG,
-				(errcode(ERRCODE_OUT_OF_MEMORY),
-				 errmsg("out of memory")));
-		CloseTransientFile(fd);
-		return NULL;
-	}
+	if (query_len >= pgss->qtext_size / 4)
+		return false;
 
-	/*
-	 * OK, slurp in the file.  If we get a short read and errno doesn't get
-	 * set, the reason is probably that garbage collection truncated the file
-	 * since we did the fstat(), so we don't log a complaint --- but we don't
-	 * return the data, either, since it's most likely corrupt due to
-	 * concurrent writes from garbage collection.
-	 */
-	errno = 0;
-	if (read(fd, buf, stat.st_size) != stat.st_size)
+	gc_qtexts();
+	while (!qtext_store(query, query_len, query_offset, NULL))
 	{
-		if (errno)
-			ereport(LOG,
-					(errcode_for_file_access(),
-				   errmsg("could not read pg_stat_statement file \"%s\": %m",
-						  PGSS_TEXT_FILE)));
-		free(buf);
-		CloseTransientFile(fd);
-		return NULL;
+		entry_dealloc();
+		gc_qtexts();
 	}
 
-	CloseTransientFile(fd);
-
-	*buffer_size = stat.st_size;
-	return buf;
+	return true;
 }
 
 /*
- * Locate a query text in the file image previously read by qtext_load_file().
+ * Locate a query text in the query text area.
  *
  * We validate the given offset/length, and return NULL if bogus.  Otherwise,
- * the result points to a null-terminated string within the buffer.
+ * the result points to a null-terminated string within the area.
+ *
+ * The caller must hold at least a shared lock on the partition lock of the
+ * entry the text belongs to, and must not modify the string.
  */
 static char *
-qtext_fetch(Size query_offset, int query_len,
-			char *buffer, Size buffer_size)
+qtext_fetch(Size query_offset, int query_len)
 {
-	/* File read failed? */
-	if (buffer == NULL)
-		return NULL;
 	/* Bogus offset/length? */
 	if (query_len < 0 ||
-		query_offset + query_len >= buffer_size)
+		query_offset + query_len >= pgss->qtext_size)
 		return NULL;
 	/* As a further sanity check, make sure there's a trailing null */
-	if (buffer[query_offset + query_len] != '\0')
+	if (pgss_qtexts[query_offset + query_len] != '\0')
 		return NULL;
 	/* Looks OK */
-	return buffer + query_offset;
+	return pgss_qtexts + query_offset;
 }
 
 /*
- * Do we need to garbage-collect the external query text file?
- *
- * Caller should hold at least a shared lock on pgss->lock.
+ * Working state for one query text during garbage collection
  */
-static bool
-need_gc_qtexts(void)
+typedef struct pgssTextRef
 {
-	Size		extent;
-
-	/* Read shared extent pointer */
-	{
-		volatile pgssSharedState *s = (volatile pgssSharedState *) pgss;
+	pgssEntry  *entry;			/* entry referencing the text */
+	Size		old_offset;		/* offset before garbage collection */
+	Size		new_offset;		/* offset after garbage collection */
+	uint32		hash;			/* hash of the text */
+	struct pgssTextRef *canon;	/* identical text that is kept, or NULL */
+} pgssTextRef;
 
-		SpinLockAcquire(&s->mutex);
-		extent = s->extent;
-		SpinLockRelease(&s->mutex);
-	}
-
-	/* Don't proceed if file does not exceed 512 bytes per possible entry */
-	if (extent < 512 * pgss_max)
-		return false;
-
-	/*
-	 * Don't proceed if file is less than about 50% bloat.  Nothing can or
-	 * should be done in the event of unusually large query texts accounting
-	 * for file's large size.  We go to the trouble of maintaining the mean
-	 * query length in order to prevent garbage collection from thrashing
-	 * uselessly.
-	 */
-	if (extent < pgss->mean_query_len * pgss_max * 2)
-		return false;
+/*
+ * qsort comparator for grouping identical texts together, lowest offset
+ * first
+ */
+static int
+textref_hash_cmp(const void *lhs, const void *rhs)
+{
+	const pgssTextRef *l = *(pgssTextRef *const *) lhs;
+	const pgssTextRef *r = *(pgssTextRef *const *) rhs;
+
+	if (l->hash != r->hash)
+		return (l->hash < r->hash) ? -1 : 1;
+	if (l->entry->query_len != r->entry->query_len)
+		return (l->entry->query_len < r->entry->query_len) ? -1 : 1;
+	if (l->old_offset != r->old_offset)
+		return (l->old_offset < r->old_offset) ? -1 : 1;
+	return 0;
+}
 
-	return true;
+/*
+ * qsort comparator for sorting into increasing offset order, with the texts
+ * that are kept ahead of their duplicates at the same offset
+ */
+static int
+textref_offset_cmp(const void *lhs, const void *rhs)
+{
+	const pgssTextRef *l = *(pgssTextRef *const *) lhs;
+	const pgssTextRef *r = *(pgssTextRef *const *) rhs;
+
+	if (l->old_offset != r->old_offset)
+		return (l->old_offset < r->old_offset) ? -1 : 1;
+	if ((l->canon != NULL) != (r->canon != NULL))
+		return (l->canon == NULL) ? -1 : 1;
+	return 0;
 }
 
 /*
- * Garbage-collect orphaned query texts in external file.
+ * Garbage-collect orphaned query texts in the query text area.
  *
- * This won't be called often in the typical case, since it's likely that
- * there won't be too much churn, and besides, a similar compaction process
- * occurs when serializing to disk at shutdown or as part of resetting.
- * Despite this, it seems prudent to plan for the edge case where the file
- * becomes unreasonably large, with no other method of compaction likely to
- * occur in the foreseeable future.
+ * The texts still referenced by the hashtable are slid down to the start of
+ * the area, dropping the ones of deallocated entries in between.  Entries
+ * whose texts are identical, typically because the same statement is run by
+ * several users or in several databases, are made to share a single copy.
  *
- * The caller must hold an exclusive lock on pgss->lock.
+ * This is called when the area is full, so the cost is spread over the many
+ * entries created since the previous garbage collection.
+ *
+ * The caller must hold all the partition locks exclusively.
  */
 static void
 gc_qtexts(void)
 {
-	char	   *qbuffer;
-	Size		qbuffer_size;
-	FILE	   *qfile;
 	HASH_SEQ_STATUS hash_seq;
 	pgssEntry  *entry;
+	pgssTextRef *refs;
+	pgssTextRef **sorted;
+	int			nrefs;
 	Size		extent;
-	int			nentries;
-
-	/*
-	 * When called from pgss_store, some other session might have proceeded
-	 * with garbage collection in the no-lock-held interim of lock strength
-	 * escalation.  Check once more that this is actually necessary.
-	 */
-	if (!need_gc_qtexts())
-		return;
-
-	/*
-	 * Load the old texts file.  If we fail (out of memory, for instance) just
-	 * skip the garbage collection.
-	 */
-	qbuffer = qtext_load_file(&qbuffer_size);
-	if (qbuffer == NULL)
-		return;
+	int			i;
 
 	/*
-	 * We overwrite the query texts file in place, so as to reduce the risk of
-	 * an out-of-disk-space failure.  Since the file is guaranteed not to get
-	 * larger, this should always work on traditional filesystems; though we
-	 * could still lose on copy-on-write filesystems.
+	 * Collect the valid texts.  Everything we need is allocated before we
+	 * start moving texts, since an error halfway through would leave the
+	 * entries pointing at the wrong texts.
 	 */
-	qfile = AllocateFile(PGSS_TEXT_FILE, PG_BINARY_W);
-	if (qfile == NULL)
-	{
-		ereport(LOG,
-				(errcode_for_file_access(),
-				 errmsg("could not write pg_stat_statement file \"%s\": %m",
-						PGSS_TEXT_FILE)));
-		goto gc_fail;
-	}
-
-	extent = 0;
-	nentries = 0;
+	refs = palloc(hash_get_num_entries(pgss_hash) * sizeof(pgssTextRef));
+	sorted = palloc(hash_get_num_entries(pgss_hash) * sizeof(pgssTextRef *));
 
+	nrefs = 0;
 	hash_seq_init(&hash_seq, pgss_hash);
 	while ((entry = hash_seq_search(&hash_seq)) != NULL)
 	{
-		int			query_len = entry->query_len;
-		char	   *qry = qtext_fetch(entry->query_offset,
-									  query_len,
-									  qbuffer,
-									  qbuffer_size);
+		char	   *qry = qtext_fetch(entry->query_offset, entry->query_len);
+		pgssTextRef *ref;
 
 		if (qry == NULL)
 		{
@@ -2066,88 +2491,74 @@ gc_qtexts(void)
 			continue;
 		}
 
-		if (fwrite(qry, 1, query_len + 1, qfile) != query_len + 1)
-		{
-			ereport(LOG,
-					(errcode_for_file_access(),
-				  errmsg("could not write pg_stat_statement file \"%s\": %m",
-						 PGSS_TEXT_FILE)));
-			hash_seq_term(&hash_seq);
-			goto gc_fail;
-		}
-
-		entry->query_offset = extent;
-		extent += query_len + 1;
-		nentries++;
+		ref = &refs[nrefs];
+		ref->entry = entry;
+		ref->old_offset = entry->query_offset;
+		ref->hash = hash_any((const unsigned char *) qry, entry->query_len);
+		ref->canon = NULL;
+		sorted[nrefs++] = ref;
 	}
 
 	/*
-	 * Truncate away any now-unused space.  If this fails for some odd reason,
-	 * we log it, but there's no need to fail.
+	 * Find identical texts.  Within each group of texts with the same hash
+	 * and length, the one with the lowest offset is kept, and the others
+	 * that really are identical to it will share it.
 	 */
-	if (ftruncate(fileno(qfile), extent) != 0)
-		ereport(LOG,
-				(errcode_for_file_access(),
-			   errmsg("could not truncate pg_stat_statement file \"%s\": %m",
-					  PGSS_TEXT_FILE)));
-
-	if (FreeFile(qfile))
+	qsort(sorted, nrefs, sizeof(pgssTextRef *), textref_hash_cmp);
+	for (i = 1; i < nrefs; i++)
 	{
-		ereport(LOG,
-				(errcode_for_file_access(),
-				 errmsg("could not write pg_stat_statement file \"%s\": %m",
-						PGSS_TEXT_FILE)));
-		qfile = NULL;
-		goto gc_fail;
+		pgssTextRef *ref = sorted[i];
+		pgssTextRef *prev = sorted[i - 1];
+		pgssTextRef *keep = prev->canon ? prev->canon : prev;
+
+		if (ref->hash == keep->hash &&
+			ref->entry->query_len == keep->entry->query_len &&
+			memcmp(pgss_qtexts + ref->old_offset,
+				   pgss_qtexts + keep->old_offset,
+				   ref->entry->query_len) == 0)
+			ref->canon = keep;
 	}
 
-	elog(DEBUG1, "pgss gc of queries file shrunk size from %zu to %zu",
-		 pgss->extent, extent);
-
-	/* Reset the shared extent pointer */
-	pgss->extent = extent;
-
 	/*
-	 * Also update the mean query length, to be sure that need_gc_qtexts()
-	 * won't still think we have a problem.
+	 * Now move the kept texts down in offset order.  A text never moves up,
+	 * so this can be done in place, and a kept text is always moved before
+	 * the texts that share it are processed.
 	 */
-	if (nentries > 0)
-		pgss->mean_query_len = extent / nentries;
-	else
-		pgss->mean_query_len = ASSUMED_LENGTH_INIT;
+	qsort(sorted, nrefs, sizeof(pgssTextRef *), textref_offset_cmp);
+	extent = 0;
+	for (i = 0; i < nrefs; i++)
+	{
+		pgssTextRef *ref = sorted[i];
+		int			query_len = ref->entry->query_len;
 
-	free(qbuffer);
+		if (ref->canon)
+			ref->new_offset = ref->canon->new_offset;
+		else
+		{
+			Assert(extent <= ref->old_offset);
+			memmove(pgss_qtexts + extent, pgss_qtexts + ref->old_offset,
+					query_len + 1);
+			ref->new_offset = extent;
+			extent += query_len + 1;
+		}
+		ref->entry->query_offset = ref->new_offset;
+	}
 
-	/*
-	 * OK, count a garbage collection cycle.  (Note: even though we have
-	 * exclusive lock on pgss->lock, we must take pgss->mutex for this, since
-	 * other processes may examine gc_count while holding only the mutex.
-	 * Also, we have to advance the count *after* we've rewritten the file,
-	 * else other processes might not realize they read a stale file.)
-	 */
-	record_gc_qtexts();
+	elog(DEBUG1, "pgss gc of query texts shrunk size from %zu to %zu",
+		 pgss->extent, extent);
 
-	return;
+	/* Reset the shared extent pointer */
+	pgss->extent = extent;
 
-gc_fail:
-	/* clean up resources */
-	if (qfile)
-		FreeFile(qfile);
-	if (qbuffer)
-		free(qbuffer);
+	pfree(refs);
+	pfree(sorted);
 
 	/*
-	 * Since the contents of the external file are now uncertain, mark all
-	 * hashtable entries as having invalid texts.
+	 * OK, count a garbage collection cycle.  (Note: even though we hold all
+	 * the partition locks exclusively, we must take pgss->mutex for this,
+	 * since other processes may examine gc_count while holding only the
+	 * mutex.)
 	 */
-	hash_seq_init(&hash_seq, pgss_hash);
-	while ((entry = hash_seq_search(&hash_seq)) != NULL)
-	{
-		entry->query_offset = 0;
-		entry->query_len = -1;
-	}
-
-	/* Seems like a good idea to bump the GC count even though we failed */
 	record_gc_qtexts();
 }
 
@@ -2159,9 +2570,15 @@ entry_reset(void)
 {
 	HASH_SEQ_STATUS hash_seq;
 	pgssEntry  *entry;
-	FILE	   *qfile;
 
-	LWLockAcquire(pgss->lock, LW_EXCLUSIVE);
+	/* Statistics this backend has accumulated go too */
+	if (pgss_pending)
+	{
+		hash_destroy(pgss_pending);
+		pgss_pending = NULL;
+	}
+
+	pgss_lock_all(LW_EXCLUSIVE);
 
 	hash_seq_init(&hash_seq, pgss_hash);
 	while ((entry = hash_seq_search(&hash_seq)) != NULL)
@@ -2169,35 +2586,13 @@ entry_reset(void)
 		hash_search(pgss_hash, &entry->key, HASH_REMOVE, NULL);
 	}
 
-	/*
-	 * Write new empty query file, perhaps even creating a new one to recover
-	 * if the file was missing.
-	 */
-	qfile = AllocateFile(PGSS_TEXT_FILE, PG_BINARY_W);
-	if (qfile == NULL)
-	{
-		ereport(LOG,
-				(errcode_for_file_access(),
-				 errmsg("could not create pg_stat_statement file \"%s\": %m",
-						PGSS_TEXT_FILE)));
-		goto done;
-	}
-
-	/* If ftruncate fails, log it, but it's not a fatal problem */
-	if (ftruncate(fileno(qfile), 0) != 0)
-		ereport(LOG,
-				(errcode_for_file_access(),
-			   errmsg("could not truncate pg_stat_statement file \"%s\": %m",
-					  PGSS_TEXT_FILE)));
-
-	FreeFile(qfile);
-
-done:
 	pgss->extent = 0;
+	pgss->stats.dealloc = 0;
+	pgss->stats.stats_reset = GetCurrentTimestamp();
 	/* This counts as a query text garbage collection for our purposes */
 	record_gc_qtexts();
 
-	LWLockRelease(pgss->lock);
+	pgss_unlock_all();
 }
 
 /*
@@ -2747,6 +3142,7 @@ JumbleExpr(pgssJumbleState *jstate, Node *node)
 
 				/* we store the string name because RTE_CTE RTEs need it */
 				APP_JUMB_STRING(cte->ctename);
+				APP_JUMB(cte->ctematerialized);
 				JumbleQuery(jstate, (Query *) cte->ctequery);
 			}
 			break;
@@ -113,3 +113,24 @@ select * from test2 where t ~ 'z foo bar';
 select * from test2 where t ~ ' z foo bar';
 select * from test2 where t ~ '  z foo bar';
 select * from test2 where t ~ '  z foo';
+
+select word_similarity('word', 'two words');
+select word_similarity('word', 'ward');
+select 'word' <% 'two words', 'word' <% 'ward', 'two words' %> 'word';
+select 'word' <<-> 'two words', 'two words' <->> 'word';
+
+CREATE TABLE test_word(t text);
+insert into test_word values ('two words'), ('words'), ('ward'), ('wordy beast'), ('nothing here');
+
+select t, word_similarity('word', t) as sml from test_word where 'word' <% t order by sml desc, t;
+create index test_word_idx on test_word using gist (t gist_trgm_ops);
+set enable_seqscan=off;
+explain (costs off)
+select t <->> 'word' as dist from test_word order by t <->> 'word' limit 4;
+select t <->> 'word' as dist from test_word order by t <->> 'word' limit 4;
+select t, word_similarity('word', t) as sml from test_word where 'word' <% t order by sml desc, t;
+drop index test_word_idx;
+create index test_word_idx on test_word using gin (t gin_trgm_ops);
+explain (costs off)
+  select t from test_word where t %> 'word';
+select t, word_similarity('word', t) as sml from test_word where 'word' <% t order by sml desc, t;
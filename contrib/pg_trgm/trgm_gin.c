@@ -88,6 +88,7 @@ gin_extract_query_trgm(PG_FUNCTION_ARGS)
 	switch (strategy)
 	{
 		case SimilarityStrategyNumber:
+		case WordSimilarityStrategyNumber:
 			trg = generate_trgm(VARDATA(val), VARSIZE(val) - VARHDRSZ);
 			break;
 		case ILikeStrategyNumber:
@@ -195,6 +196,22 @@ gin_trgm_consistent(PG_FUNCTION_ARGS)
 			res = (nkeys == 0) ? false : ((((((float4) ntrue) / ((float4) nkeys))) >= trgm_limit) ? true : false);
 #endif
 			break;
+		case WordSimilarityStrategyNumber:
+			/* Count the matches */
+			ntrue = 0;
+			for (i = 0; i < nkeys; i++)
+			{
+				if (check[i])
+					ntrue++;
+			}
+
+			/*
+			 * The fraction of the query's trigrams present in the item is an
+			 * upper bound of its word similarity.
+			 */
+			res = (nkeys == 0) ? false :
+				(CALCSML(ntrue, nkeys, ntrue) >= word_similarity_threshold);
+			break;
 		case ILikeStrategyNumber:
 #ifndef IGNORECASE
 			elog(ERROR, "cannot handle ~~* with case-sensitive trigrams");
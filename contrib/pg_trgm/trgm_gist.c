@@ -218,6 +218,7 @@ gtrgm_consistent(PG_FUNCTION_ARGS)
 		switch (strategy)
 		{
 			case SimilarityStrategyNumber:
+			case WordSimilarityStrategyNumber:
 				qtrg = generate_trgm(VARDATA(query),
 									 querysize - VARHDRSZ);
 				break;
@@ -291,7 +292,7 @@ gtrgm_consistent(PG_FUNCTION_ARGS)
 
 			if (GIST_LEAF(entry))
 			{					/* all leafs contains orig trgm */
-				float4		tmpsml = cnt_sml(key, qtrg);
+				float4		tmpsml = cnt_sml(key, qtrg, false);
 
 				/* strange bug at freebsd 5.2.1 and gcc 3.3.3 */
 				res = (*(int *) &tmpsml == *(int *) &trgm_limit || tmpsml > trgm_limit) ? true : false;
@@ -311,6 +312,29 @@ gtrgm_consistent(PG_FUNCTION_ARGS)
 					res = (((((float8) count) / ((float8) len))) >= trgm_limit) ? true : false;
 			}
 			break;
+		case WordSimilarityStrategyNumber:
+			/* Word similarity search is inexact */
+			*recheck = true;
+
+			if (GIST_LEAF(entry))
+			{					/* all leafs contains orig trgm */
+				res = (cnt_sml(qtrg, key, true) >= word_similarity_threshold);
+			}
+			else if (ISALLTRUE(key))
+			{					/* non-leaf contains signature */
+				res = true;
+			}
+			else
+			{					/* non-leaf contains signature */
+				int32		count = cnt_sml_sign_common(qtrg, GETSIGN(key));
+				int32		len = ARRNELEM(qtrg);
+
+				if (len == 0)
+					res = false;
+				else
+					res = (CALCSML(count, len, count) >= word_similarity_threshold);
+			}
+			break;
 		case ILikeStrategyNumber:
 #ifndef IGNORECASE
 			elog(ERROR, "cannot handle ~~* with case-sensitive trigrams");
@@ -426,6 +450,7 @@ gtrgm_distance(PG_FUNCTION_ARGS)
 	StrategyNumber strategy = (StrategyNumber) PG_GETARG_UINT16(2);
 
 	/* Oid		subtype = PG_GETARG_OID(3); */
+	bool	   *recheck = (bool *) PG_GETARG_POINTER(4);
 	TRGM	   *key = (TRGM *) DatumGetPointer(entry->key);
 	TRGM	   *qtrg;
 	float8		res;
@@ -463,7 +488,26 @@ gtrgm_distance(PG_FUNCTION_ARGS)
 		case DistanceStrategyNumber:
 			if (GIST_LEAF(entry))
 			{					/* all leafs contains orig trgm */
-				res = 1.0 - cnt_sml(key, qtrg);
+				res = 1.0 - cnt_sml(key, qtrg, false);
+			}
+			else if (ISALLTRUE(key))
+			{					/* all leafs contains orig trgm */
+				res = 0.0;
+			}
+			else
+			{					/* non-leaf contains signature */
+				int32		count = cnt_sml_sign_common(qtrg, GETSIGN(key));
+				int32		len = ARRNELEM(qtrg);
+
+				res = (len == 0) ? -1.0 : 1.0 - ((float8) count) / ((float8) len);
+			}
+			break;
+		case WordDistanceStrategyNumber:
+			/* Only plain trigram distance is exact */
+			*recheck = true;
+			if (GIST_LEAF(entry))
+			{					/* all leafs contains orig trgm */
+				res = 1.0 - cnt_sml(qtrg, key, true);
 			}
 			else if (ISALLTRUE(key))
 			{					/* all leafs contains orig trgm */
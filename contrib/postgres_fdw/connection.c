@@ -34,6 +34,10 @@
  * commands at the same nesting depth on the remote as we're executing at
  * ourselves, so that rolling back a subtransaction will kill the right
  * queries and not the wrong ones.
+ *
+ * A scan running asynchronously may leave a query in progress on the
+ * connection while other scans run.  pending_callback is then set, and must
+ * be called to collect its result before anything else is sent.
  */
 typedef struct ConnCacheKey
 {
@@ -49,6 +53,8 @@ typedef struct ConnCacheEntry
 								 * one level of subxact open, etc */
 	bool		have_prep_stmt; /* have we prepared any stmts in this xact? */
 	bool		have_error;		/* have any subxacts aborted in this xact? */
+	PendingRequestCallback pending_callback;	/* NULL if no query pending */
+	void	   *pending_arg;	/* argument for pending_callback */
 } ConnCacheEntry;
 
 /*
@@ -63,12 +69,17 @@ static unsigned int prep_stmt_number = 0;
 /* tracks whether any work is needed in callback functions */
 static bool xact_got_connection = false;
 
+/* number of connections with a query pending */
+static int	num_pending_requests = 0;
+
 /* prototypes of private functions */
 static PGconn *connect_pg_server(ForeignServer *server, UserMapping *user);
 static void check_conn_params(const char **keywords, const char **values);
 static void configure_remote_session(PGconn *conn);
 static void do_sql_command(PGconn *conn, const char *sql);
 static void begin_remote_xact(ConnCacheEntry *entry);
+static ConnCacheEntry *find_conn_entry(PGconn *conn);
+static void clear_pending_request(ConnCacheEntry *entry);
 static void pgfdw_xact_callback(XactEvent event, void *arg);
 static void pgfdw_subxact_callback(SubXactEvent event,
 					   SubTransactionId mySubid,
@@ -141,6 +152,8 @@ GetConnection(ForeignServer *server, UserMapping *user,
 		entry->xact_depth = 0;
 		entry->have_prep_stmt = false;
 		entry->have_error = false;
+		entry->pending_callback = NULL;
+		entry->pending_arg = NULL;
 	}
 
 	/*
@@ -352,6 +365,7 @@ do_sql_command(PGconn *conn, const char *sql)
 {
 	PGresult   *res;
 
+	CompletePendingRequest(conn);
 	res = PQexec(conn, sql);
 	if (PQresultStatus(res) != PGRES_COMMAND_OK)
 		pgfdw_report_error(ERROR, res, conn, true, sql);
@@ -448,6 +462,85 @@ GetPrepStmtNumber(PGconn *conn)
 	return ++prep_stmt_number;
 }
 
+/*
+ * Find the cache entry of a connection.
+ */
+static ConnCacheEntry *
+find_conn_entry(PGconn *conn)
+{
+	HASH_SEQ_STATUS scan;
+	ConnCacheEntry *entry;
+
+	hash_seq_init(&scan, ConnectionHash);
+	while ((entry = (ConnCacheEntry *) hash_seq_search(&scan)))
+	{
+		if (entry->conn == conn)
+		{
+			hash_seq_term(&scan);
+			return entry;
+		}
+	}
+
+	elog(ERROR, "could not find postgres_fdw connection %p", conn);
+	return NULL;				/* keep compiler quiet */
+}
+
+/*
+ * Record that a query was sent on the connection whose result is yet to be
+ * collected, by calling callback(arg).  Anything else that wants to use the
+ * connection calls CompletePendingRequest first.  Pass a NULL callback once
+ * the result has been collected.
+ */
+void
+SetPendingRequest(PGconn *conn, PendingRequestCallback callback, void *arg)
+{
+	ConnCacheEntry *entry = find_conn_entry(conn);
+
+	if (entry->pending_callback == NULL && callback != NULL)
+		num_pending_requests++;
+	else if (entry->pending_callback != NULL && callback == NULL)
+		num_pending_requests--;
+	entry->pending_callback = callback;
+	entry->pending_arg = arg;
+}
+
+/*
+ * Collect the result of the query pending on the connection, if any, so
+ * that it can be used for something else.
+ */
+void
+CompletePendingRequest(PGconn *conn)
+{
+	ConnCacheEntry *entry;
+	PendingRequestCallback callback;
+
+	/* Quick exit in the common case that nothing is pending anywhere */
+	if (num_pending_requests == 0)
+		return;
+
+	entry = find_conn_entry(conn);
+	if (entry->pending_callback == NULL)
+		return;
+
+	/* The callback is expected to clear the pending request */
+	callback = entry->pending_callback;
+	callback(entry->pending_arg);
+	Assert(entry->pending_callback == NULL);
+}
+
+/*
+ * Forget about the query pending on the connection, during abort.  The
+ * result will be discarded by the next PQexec.
+ */
+static void
+clear_pending_request(ConnCacheEntry *entry)
+{
+	if (entry->pending_callback != NULL)
+		num_pending_requests--;
+	entry->pending_callback = NULL;
+	entry->pending_arg = NULL;
+}
+
 /*
  * Report an error we got from the remote server.
  *
@@ -597,6 +690,8 @@ pgfdw_xact_callback(XactEvent event, void *arg)
 					break;
 				case XACT_EVENT_PARALLEL_ABORT:
 				case XACT_EVENT_ABORT:
+					/* The scan waiting for a pending result is gone */
+					clear_pending_request(entry);
 					/* Assume we might have lost track of prepared statements */
 					entry->have_error = true;
 					/* If we're aborting, abort all remote transactions too */
@@ -698,6 +793,8 @@ pgfdw_subxact_callback(SubXactEvent event, SubTransactionId mySubid,
 		}
 		else
 		{
+			/* The scan waiting for a pending result is gone */
+			clear_pending_request(entry);
 			/* Assume we might have lost track of prepared statements */
 			entry->have_error = true;
 			/* Rollback all remote subtransactions during abort */
@@ -18,11 +18,16 @@
  * the remote server: it might not have the same collation names we do.
  * (Later we might consider it safe to send COLLATE "C", but even that would
  * fail on old remote servers.)  An expression is considered safe to send only
- * if all collations used in it are traceable to Var(s) of the foreign table.
+ * if all collations used in it are traceable to Var(s) of the foreign table(s).
  * That implies that if the remote server gets a different answer than we do,
  * the foreign table's columns are not marked with collations that match the
  * remote table's columns, which we can consider to be user error.
  *
+ * Besides scans of single foreign tables, we construct queries for joins of
+ * foreign tables on the same server, in which each table is given the alias
+ * r<rtindex> and every column reference is qualified with it, and for
+ * aggregation over a foreign table or such a join.
+ *
  * Portions Copyright (c) 2012-2015, PostgreSQL Global Development Group
  *
  * IDENTIFICATION
@@ -36,8 +41,10 @@
 
 #include "access/heapam.h"
 #include "access/htup_details.h"
+#include "access/stratnum.h"
 #include "access/sysattr.h"
 #include "access/transam.h"
+#include "catalog/pg_aggregate.h"
 #include "catalog/pg_collation.h"
 #include "catalog/pg_namespace.h"
 #include "catalog/pg_operator.h"
@@ -46,6 +53,7 @@
 #include "commands/defrem.h"
 #include "nodes/nodeFuncs.h"
 #include "optimizer/clauses.h"
+#include "optimizer/tlist.h"
 #include "optimizer/var.h"
 #include "parser/parsetree.h"
 #include "utils/builtins.h"
@@ -61,6 +69,7 @@ typedef struct foreign_glob_cxt
 {
 	PlannerInfo *root;			/* global planner state */
 	RelOptInfo *foreignrel;		/* the foreign relation we are planning for */
+	bool		agg_ok;			/* may the expression contain aggregates? */
 } foreign_glob_cxt;
 
 /*
@@ -86,7 +95,7 @@ typedef struct foreign_loc_cxt
 typedef struct deparse_expr_cxt
 {
 	PlannerInfo *root;			/* global planner state */
-	RelOptInfo *foreignrel;		/* the foreign relation we are planning for */
+	RelOptInfo *foreignrel;		/* the foreign relation (or join) scanned */
 	StringInfo	buf;			/* output buffer to append to */
 	List	  **params_list;	/* exprs that will become remote Params */
 } deparse_expr_cxt;
@@ -95,6 +104,10 @@ typedef struct deparse_expr_cxt
  * Functions to determine whether an expression can be evaluated safely on
  * remote server.
  */
+static bool foreign_expr_ok(PlannerInfo *root,
+				RelOptInfo *foreignrel,
+				Expr *expr,
+				bool agg_ok);
 static bool foreign_expr_walker(Node *node,
 					foreign_glob_cxt *glob_cxt,
 					foreign_loc_cxt *outer_cxt);
@@ -114,8 +127,15 @@ static void deparseReturningList(StringInfo buf, PlannerInfo *root,
 					 bool trig_after_row,
 					 List *returningList,
 					 List **retrieved_attrs);
+static void deparseExplicitTargetList(List *tlist, List **retrieved_attrs,
+						  deparse_expr_cxt *context);
+static void deparseFromExprForRel(RelOptInfo *foreignrel,
+					  deparse_expr_cxt *context);
+static void appendConditions(List *exprs, deparse_expr_cxt *context);
+static void appendOrderByClause(List *pathkeys, deparse_expr_cxt *context);
 static void deparseColumnRef(StringInfo buf, int varno, int varattno,
-				 PlannerInfo *root);
+				 PlannerInfo *root, bool qualify_col);
+static void deparseAttributeName(StringInfo buf, Oid relid, int attnum);
 static void deparseRelation(StringInfo buf, Relation rel);
 static void deparseExpr(Expr *expr, deparse_expr_cxt *context);
 static void deparseVar(Var *node, deparse_expr_cxt *context);
@@ -132,6 +152,7 @@ static void deparseRelabelType(RelabelType *node, deparse_expr_cxt *context);
 static void deparseBoolExpr(BoolExpr *node, deparse_expr_cxt *context);
 static void deparseNullTest(NullTest *node, deparse_expr_cxt *context);
 static void deparseArrayExpr(ArrayExpr *node, deparse_expr_cxt *context);
+static void deparseAggref(Aggref *node, deparse_expr_cxt *context);
 static void printRemoteParam(int paramindex, Oid paramtype, int32 paramtypmod,
 				 deparse_expr_cxt *context);
 static void printRemotePlaceholder(Oid paramtype, int32 paramtypmod,
@@ -168,12 +189,37 @@ classifyConditions(PlannerInfo *root,
 }
 
 /*
- * Returns true if given expr is safe to evaluate on the foreign server.
+ * Returns true if given expr is safe to evaluate on the foreign server,
+ * when scanning baserel (a foreign table, or a join of foreign tables).
  */
 bool
 is_foreign_expr(PlannerInfo *root,
 				RelOptInfo *baserel,
 				Expr *expr)
+{
+	return foreign_expr_ok(root, baserel, expr, false);
+}
+
+/*
+ * Returns true if given expr, which may contain aggregates, is safe to
+ * evaluate on the foreign server when grouping the rows of input_rel.
+ */
+bool
+is_foreign_grouping_expr(PlannerInfo *root,
+						 RelOptInfo *input_rel,
+						 Expr *expr)
+{
+	return foreign_expr_ok(root, input_rel, expr, true);
+}
+
+/*
+ * Workhorse for is_foreign_expr and is_foreign_grouping_expr.
+ */
+static bool
+foreign_expr_ok(PlannerInfo *root,
+				RelOptInfo *foreignrel,
+				Expr *expr,
+				bool agg_ok)
 {
 	foreign_glob_cxt glob_cxt;
 	foreign_loc_cxt loc_cxt;
@@ -183,15 +229,20 @@ is_foreign_expr(PlannerInfo *root,
 	 * remotely.
 	 */
 	glob_cxt.root = root;
-	glob_cxt.foreignrel = baserel;
+	glob_cxt.foreignrel = foreignrel;
+	glob_cxt.agg_ok = agg_ok;
 	loc_cxt.collation = InvalidOid;
 	loc_cxt.state = FDW_COLLATE_NONE;
 	if (!foreign_expr_walker((Node *) expr, &glob_cxt, &loc_cxt))
 		return false;
 
-	/* Expressions examined here should be boolean, ie noncollatable */
-	Assert(loc_cxt.collation == InvalidOid);
-	Assert(loc_cxt.state == FDW_COLLATE_NONE);
+	/*
+	 * Conditions are boolean, ie noncollatable, but target list entries and
+	 * sort keys may have a collation, which must then derive from a foreign
+	 * Var.
+	 */
+	if (loc_cxt.state == FDW_COLLATE_UNSAFE)
+		return false;
 
 	/*
 	 * An expression which includes any mutable functions can't be sent over
@@ -244,13 +295,13 @@ foreign_expr_walker(Node *node,
 				Var		   *var = (Var *) node;
 
 				/*
-				 * If the Var is from the foreign table, we consider its
-				 * collation (if any) safe to use.  If it is from another
-				 * table, we treat its collation the same way as we would a
-				 * Param's collation, ie it's not safe for it to have a
-				 * non-default collation.
+				 * If the Var is from the foreign table (or one of the joined
+				 * foreign tables), we consider its collation (if any) safe to
+				 * use.  If it is from another table, we treat its collation
+				 * the same way as we would a Param's collation, ie it's not
+				 * safe for it to have a non-default collation.
 				 */
-				if (var->varno == glob_cxt->foreignrel->relid &&
+				if (bms_is_member(var->varno, glob_cxt->foreignrel->relids) &&
 					var->varlevelsup == 0)
 				{
 					/* Var belongs to foreign table */
@@ -578,6 +629,62 @@ foreign_expr_walker(Node *node,
 				check_type = false;
 			}
 			break;
+		case T_Aggref:
+			{
+				Aggref	   *agg = (Aggref *) node;
+				ListCell   *lc;
+
+				/* Aggregates are only allowed when grouping remotely */
+				if (!glob_cxt->agg_ok || agg->agglevelsup != 0)
+					return false;
+
+				/*
+				 * Only plain aggregates without ORDER BY, DISTINCT or FILTER,
+				 * and only built-in ones.
+				 */
+				if (agg->aggkind != AGGKIND_NORMAL ||
+					agg->aggorder != NIL ||
+					agg->aggdistinct != NIL ||
+					agg->aggfilter != NULL)
+					return false;
+				if (!is_builtin(agg->aggfnoid))
+					return false;
+
+				/*
+				 * Recurse to the arguments, which are TargetEntries.  An
+				 * aggregate can't contain another one of the same level.
+				 */
+				glob_cxt->agg_ok = false;
+				foreach(lc, agg->args)
+				{
+					TargetEntry *tle = (TargetEntry *) lfirst(lc);
+
+					if (!foreign_expr_walker((Node *) tle->expr,
+											 glob_cxt, &inner_cxt))
+					{
+						glob_cxt->agg_ok = true;
+						return false;
+					}
+				}
+				glob_cxt->agg_ok = true;
+
+				/* Collation handling is same as for functions */
+				if (agg->inputcollid == InvalidOid)
+					 /* OK, inputs are all noncollatable */ ;
+				else if (inner_cxt.state != FDW_COLLATE_SAFE ||
+						 agg->inputcollid != inner_cxt.collation)
+					return false;
+
+				collation = agg->aggcollid;
+				if (collation == InvalidOid)
+					state = FDW_COLLATE_NONE;
+				else if (inner_cxt.state == FDW_COLLATE_SAFE &&
+						 collation == inner_cxt.collation)
+					state = FDW_COLLATE_SAFE;
+				else
+					state = FDW_COLLATE_UNSAFE;
+			}
+			break;
 		default:
 
 			/*
@@ -669,43 +776,342 @@ is_builtin(Oid oid)
 
 
 /*
- * Construct a simple SELECT statement that retrieves desired columns
- * of the specified foreign table, and append it to "buf".  The output
- * contains just "SELECT ... FROM tablename".
+ * Construct a SELECT statement that scans foreignrel, a foreign table or a
+ * join of foreign tables on the same server, and append it to "buf".
+ *
+ * For a foreign table we fetch the columns in fpinfo->attrs_used, for a join
+ * the expressions in tlist, which are the only columns of the rows returned.
+ * remote_conds is a list of RestrictInfos to check in the WHERE clause.  If
+ * pathkeys isn't NIL the rows are sorted accordingly, and if limit_tuples is
+ * positive at most that many are returned.
  *
  * We also create an integer List of the columns being retrieved, which is
- * returned to *retrieved_attrs.
+ * returned to *retrieved_attrs: attribute numbers of the foreign table, or
+ * positions in tlist for a join.
+ *
+ * If params_list is not NULL, it receives a list of Params and other-relation
+ * Vars used in the query; these values must be transmitted to the remote
+ * server as parameter values.  If it is NULL, we're generating the query for
+ * EXPLAIN purposes, so Params and other-relation Vars should be replaced by
+ * dummy values.
  */
 void
-deparseSelectSql(StringInfo buf,
-				 PlannerInfo *root,
-				 RelOptInfo *baserel,
-				 Bitmapset *attrs_used,
-				 List **retrieved_attrs)
+deparseSelectStmtForRel(StringInfo buf,
+						PlannerInfo *root,
+						RelOptInfo *foreignrel,
+						List *tlist,
+						List *remote_conds,
+						List *pathkeys,
+						double limit_tuples,
+						List **retrieved_attrs,
+						List **params_list)
 {
-	RangeTblEntry *rte = planner_rt_fetch(baserel->relid, root);
-	Relation	rel;
+	deparse_expr_cxt context;
+	int			nestlevel;
 
-	/*
-	 * Core code already has some lock on each rel being planned, so we can
-	 * use NoLock here.
-	 */
-	rel = heap_open(rte->relid, NoLock);
+	if (params_list)
+		*params_list = NIL;		/* initialize result list to empty */
+
+	/* Set up context struct for recursion */
+	context.root = root;
+	context.foreignrel = foreignrel;
+	context.buf = buf;
+	context.params_list = params_list;
+
+	/* Make sure any constants in the exprs are printed portably */
+	nestlevel = set_transmission_modes();
 
 	/*
 	 * Construct SELECT list
 	 */
 	appendStringInfoString(buf, "SELECT ");
-	deparseTargetList(buf, root, baserel->relid, rel, attrs_used,
-					  retrieved_attrs);
+	if (foreignrel->reloptkind == RELOPT_JOINREL)
+		deparseExplicitTargetList(tlist, retrieved_attrs, &context);
+	else
+	{
+		PgFdwRelationInfo *fpinfo = (PgFdwRelationInfo *) foreignrel->fdw_private;
+		RangeTblEntry *rte = planner_rt_fetch(foreignrel->relid, root);
+		Relation	rel;
+
+		/*
+		 * Core code already has some lock on each rel being planned, so we
+		 * can use NoLock here.
+		 */
+		rel = heap_open(rte->relid, NoLock);
+		deparseTargetList(buf, root, foreignrel->relid, rel,
+						  fpinfo->attrs_used, retrieved_attrs);
+		heap_close(rel, NoLock);
+	}
 
 	/*
-	 * Construct FROM clause
+	 * Construct FROM and WHERE clauses
 	 */
 	appendStringInfoString(buf, " FROM ");
-	deparseRelation(buf, rel);
+	deparseFromExprForRel(foreignrel, &context);
+	if (remote_conds)
+	{
+		appendStringInfoString(buf, " WHERE ");
+		appendConditions(remote_conds, &context);
+	}
+
+	/* Add ORDER BY and LIMIT clauses if wanted */
+	if (pathkeys)
+		appendOrderByClause(pathkeys, &context);
+	if (limit_tuples > 0)
+		appendStringInfo(buf, " LIMIT %.0f", limit_tuples);
+
+	reset_transmission_modes(nestlevel);
+}
+
+/*
+ * Construct a SELECT statement that computes tlist, the target list of a
+ * query with aggregates and/or GROUP BY, over input_rel, a foreign table or
+ * a join of foreign tables, and append it to "buf".
+ *
+ * remote_conds are the RestrictInfos to check in the WHERE clause, and
+ * having_quals the (implicitly ANDed) HAVING conditions.  The GROUP BY
+ * clause refers to the grouping columns by their position in tlist.
+ * retrieved_attrs and params_list are as for deparseSelectStmtForRel.
+ */
+void
+deparseSelectStmtForGrouping(StringInfo buf,
+							 PlannerInfo *root,
+							 RelOptInfo *input_rel,
+							 List *tlist,
+							 List *remote_conds,
+							 List *having_quals,
+							 List **retrieved_attrs,
+							 List **params_list)
+{
+	deparse_expr_cxt context;
+	int			nestlevel;
+
+	if (params_list)
+		*params_list = NIL;		/* initialize result list to empty */
+
+	/* Set up context struct for recursion */
+	context.root = root;
+	context.foreignrel = input_rel;
+	context.buf = buf;
+	context.params_list = params_list;
+
+	/* Make sure any constants in the exprs are printed portably */
+	nestlevel = set_transmission_modes();
+
+	appendStringInfoString(buf, "SELECT ");
+	deparseExplicitTargetList(tlist, retrieved_attrs, &context);
+
+	appendStringInfoString(buf, " FROM ");
+	deparseFromExprForRel(input_rel, &context);
+	if (remote_conds)
+	{
+		appendStringInfoString(buf, " WHERE ");
+		appendConditions(remote_conds, &context);
+	}
+
+	if (root->parse->groupClause)
+	{
+		const char *delim = " GROUP BY ";
+		ListCell   *lc;
+
+		foreach(lc, root->parse->groupClause)
+		{
+			SortGroupClause *grp = (SortGroupClause *) lfirst(lc);
+			TargetEntry *tle = get_sortgroupclause_tle(grp, tlist);
 
-	heap_close(rel, NoLock);
+			appendStringInfo(buf, "%s%d", delim, tle->resno);
+			delim = ", ";
+		}
+	}
+
+	if (having_quals)
+	{
+		appendStringInfoString(buf, " HAVING ");
+		appendConditions(having_quals, &context);
+	}
+
+	reset_transmission_modes(nestlevel);
+}
+
+/*
+ * Emit a target list that retrieves the expressions in tlist, a list of
+ * TargetEntries, and build the integer List of their positions that is
+ * returned to *retrieved_attrs.
+ */
+static void
+deparseExplicitTargetList(List *tlist, List **retrieved_attrs,
+						  deparse_expr_cxt *context)
+{
+	StringInfo	buf = context->buf;
+	ListCell   *lc;
+	int			i = 0;
+
+	*retrieved_attrs = NIL;
+
+	foreach(lc, tlist)
+	{
+		TargetEntry *tle = (TargetEntry *) lfirst(lc);
+
+		if (i > 0)
+			appendStringInfoString(buf, ", ");
+		deparseExpr(tle->expr, context);
+
+		*retrieved_attrs = lappend_int(*retrieved_attrs, i + 1);
+		i++;
+	}
+
+	/* Don't generate bad syntax if no columns are needed */
+	if (i == 0)
+		appendStringInfoString(buf, "NULL");
+}
+
+/*
+ * Deparse the FROM clause item for foreignrel: the name of a foreign table,
+ * or for a join, the joined relations in parentheses, with the join
+ * conditions.  Within a join every table gets an alias, see
+ * deparseColumnRef.
+ */
+static void
+deparseFromExprForRel(RelOptInfo *foreignrel, deparse_expr_cxt *context)
+{
+	StringInfo	buf = context->buf;
+
+	if (foreignrel->reloptkind == RELOPT_JOINREL)
+	{
+		PgFdwRelationInfo *fpinfo = (PgFdwRelationInfo *) foreignrel->fdw_private;
+
+		appendStringInfoChar(buf, '(');
+		deparseFromExprForRel(fpinfo->outerrel, context);
+		appendStringInfo(buf, " %s JOIN ", get_jointype_name(fpinfo->jointype));
+		deparseFromExprForRel(fpinfo->innerrel, context);
+		appendStringInfoString(buf, " ON ");
+		if (fpinfo->joinclauses)
+			appendConditions(fpinfo->joinclauses, context);
+		else
+			appendStringInfoString(buf, "(TRUE)");
+		appendStringInfoChar(buf, ')');
+	}
+	else
+	{
+		RangeTblEntry *rte = planner_rt_fetch(foreignrel->relid, context->root);
+		Relation	rel;
+
+		rel = heap_open(rte->relid, NoLock);
+		deparseRelation(buf, rel);
+		heap_close(rel, NoLock);
+
+		if (context->foreignrel->reloptkind == RELOPT_JOINREL)
+			appendStringInfo(buf, " %s%d", REL_ALIAS_PREFIX, foreignrel->relid);
+	}
+}
+
+/*
+ * Output the SQL name of a join type, for deparseFromExprForRel.
+ */
+const char *
+get_jointype_name(JoinType jointype)
+{
+	switch (jointype)
+	{
+		case JOIN_INNER:
+			return "INNER";
+		case JOIN_LEFT:
+			return "LEFT";
+		case JOIN_RIGHT:
+			return "RIGHT";
+		case JOIN_FULL:
+			return "FULL";
+		default:
+			elog(ERROR, "unsupported join type %d", (int) jointype);
+			return NULL;		/* keep compiler quiet */
+	}
+}
+
+/*
+ * Deparse the conditions in exprs, which may be RestrictInfos or bare
+ * expressions, and append them to buf, connected with "AND" and each in
+ * parentheses.
+ */
+static void
+appendConditions(List *exprs, deparse_expr_cxt *context)
+{
+	StringInfo	buf = context->buf;
+	bool		is_first = true;
+	ListCell   *lc;
+
+	foreach(lc, exprs)
+	{
+		Expr	   *expr = (Expr *) lfirst(lc);
+
+		if (IsA(expr, RestrictInfo))
+			expr = ((RestrictInfo *) expr)->clause;
+
+		if (!is_first)
+			appendStringInfoString(buf, " AND ");
+
+		appendStringInfoChar(buf, '(');
+		deparseExpr(expr, context);
+		appendStringInfoChar(buf, ')');
+
+		is_first = false;
+	}
+}
+
+/*
+ * Append an ORDER BY clause sorting the rows by pathkeys.  Every pathkey
+ * must have an equivalence member computable from context->foreignrel, see
+ * find_em_expr_for_rel.
+ */
+static void
+appendOrderByClause(List *pathkeys, deparse_expr_cxt *context)
+{
+	StringInfo	buf = context->buf;
+	const char *delim = " ORDER BY ";
+	ListCell   *lc;
+
+	foreach(lc, pathkeys)
+	{
+		PathKey    *pathkey = (PathKey *) lfirst(lc);
+		Expr	   *em_expr;
+
+		em_expr = find_em_expr_for_rel(pathkey->pk_eclass,
+									   context->foreignrel);
+		Assert(em_expr != NULL);
+
+		appendStringInfoString(buf, delim);
+		deparseExpr(em_expr, context);
+		if (pathkey->pk_strategy == BTLessStrategyNumber)
+			appendStringInfoString(buf, " ASC");
+		else
+			appendStringInfoString(buf, " DESC");
+		if (pathkey->pk_nulls_first)
+			appendStringInfoString(buf, " NULLS FIRST");
+		else
+			appendStringInfoString(buf, " NULLS LAST");
+
+		delim = ", ";
+	}
+}
+
+/*
+ * Find an expression of the equivalence class ec that can be computed from
+ * the columns of rel alone, or NULL if there is none.
+ */
+Expr *
+find_em_expr_for_rel(EquivalenceClass *ec, RelOptInfo *rel)
+{
+	ListCell   *lc;
+
+	foreach(lc, ec->ec_members)
+	{
+		EquivalenceMember *em = (EquivalenceMember *) lfirst(lc);
+
+		if (!bms_is_empty(em->em_relids) &&
+			bms_is_subset(em->em_relids, rel->relids))
+			return em->em_expr;
+	}
+
+	return NULL;
 }
 
 /*
@@ -751,7 +1157,7 @@ deparseTargetList(StringInfo buf,
 				appendStringInfoString(buf, ", ");
 			first = false;
 
-			deparseColumnRef(buf, rtindex, i, root);
+			deparseColumnRef(buf, rtindex, i, root, false);
 
 			*retrieved_attrs = lappend_int(*retrieved_attrs, i);
 		}
@@ -779,64 +1185,6 @@ deparseTargetList(StringInfo buf,
 		appendStringInfoString(buf, "NULL");
 }
 
-/*
- * Deparse WHERE clauses in given list of RestrictInfos and append them to buf.
- *
- * baserel is the foreign table we're planning for.
- *
- * If no WHERE clause already exists in the buffer, is_first should be true.
- *
- * If params is not NULL, it receives a list of Params and other-relation Vars
- * used in the clauses; these values must be transmitted to the remote server
- * as parameter values.
- *
- * If params is NULL, we're generating the query for EXPLAIN purposes,
- * so Params and other-relation Vars should be replaced by dummy values.
- */
-void
-appendWhereClause(StringInfo buf,
-				  PlannerInfo *root,
-				  RelOptInfo *baserel,
-				  List *exprs,
-				  bool is_first,
-				  List **params)
-{
-	deparse_expr_cxt context;
-	int			nestlevel;
-	ListCell   *lc;
-
-	if (params)
-		*params = NIL;			/* initialize result list to empty */
-
-	/* Set up context struct for recursion */
-	context.root = root;
-	context.foreignrel = baserel;
-	context.buf = buf;
-	context.params_list = params;
-
-	/* Make sure any constants in the exprs are printed portably */
-	nestlevel = set_transmission_modes();
-
-	foreach(lc, exprs)
-	{
-		RestrictInfo *ri = (RestrictInfo *) lfirst(lc);
-
-		/* Connect expressions with "AND" and parenthesize each condition. */
-		if (is_first)
-			appendStringInfoString(buf, " WHERE ");
-		else
-			appendStringInfoString(buf, " AND ");
-
-		appendStringInfoChar(buf, '(');
-		deparseExpr(ri->clause, &context);
-		appendStringInfoChar(buf, ')');
-
-		is_first = false;
-	}
-
-	reset_transmission_modes(nestlevel);
-}
-
 /*
  * deparse remote INSERT statement
  *
@@ -870,7 +1218,7 @@ deparseInsertSql(StringInfo buf, PlannerInfo *root,
 				appendStringInfoString(buf, ", ");
 			first = false;
 
-			deparseColumnRef(buf, rtindex, attnum, root);
+			deparseColumnRef(buf, rtindex, attnum, root, false);
 		}
 
 		appendStringInfoString(buf, ") VALUES (");
@@ -900,6 +1248,100 @@ deparseInsertSql(StringInfo buf, PlannerInfo *root,
 						 returningList, retrieved_attrs);
 }
 
+/*
+ * deparse remote INSERT statement for COPY FROM
+ *
+ * Like deparseInsertSql, but the statement inserts 'nrows' rows, numbering
+ * the parameters row by row, and doesn't need a PlannerInfo.  If there are
+ * AFTER ROW triggers, the statement returns all columns; the attribute
+ * numbers are returned to *retrieved_attrs.
+ */
+void
+deparseBatchInsertSql(StringInfo buf, Relation rel, List *targetAttrs,
+					  int nrows, bool trig_after_row,
+					  List **retrieved_attrs)
+{
+	Oid			relid = RelationGetRelid(rel);
+	AttrNumber	pindex;
+	bool		first;
+	ListCell   *lc;
+	int			i;
+
+	appendStringInfoString(buf, "INSERT INTO ");
+	deparseRelation(buf, rel);
+
+	if (targetAttrs)
+	{
+		appendStringInfoChar(buf, '(');
+
+		first = true;
+		foreach(lc, targetAttrs)
+		{
+			int			attnum = lfirst_int(lc);
+
+			if (!first)
+				appendStringInfoString(buf, ", ");
+			first = false;
+
+			deparseAttributeName(buf, relid, attnum);
+		}
+
+		appendStringInfoString(buf, ") VALUES ");
+
+		pindex = 1;
+		for (i = 0; i < nrows; i++)
+		{
+			if (i > 0)
+				appendStringInfoString(buf, ", ");
+			appendStringInfoChar(buf, '(');
+
+			first = true;
+			foreach(lc, targetAttrs)
+			{
+				if (!first)
+					appendStringInfoString(buf, ", ");
+				first = false;
+
+				appendStringInfo(buf, "$%d", pindex);
+				pindex++;
+			}
+
+			appendStringInfoChar(buf, ')');
+		}
+	}
+	else
+	{
+		Assert(nrows == 1);
+		appendStringInfoString(buf, " DEFAULT VALUES");
+	}
+
+	*retrieved_attrs = NIL;
+	if (trig_after_row)
+	{
+		TupleDesc	tupdesc = RelationGetDescr(rel);
+
+		appendStringInfoString(buf, " RETURNING ");
+
+		first = true;
+		for (i = 1; i <= tupdesc->natts; i++)
+		{
+			if (tupdesc->attrs[i - 1]->attisdropped)
+				continue;
+
+			if (!first)
+				appendStringInfoString(buf, ", ");
+			first = false;
+
+			deparseAttributeName(buf, relid, i);
+			*retrieved_attrs = lappend_int(*retrieved_attrs, i);
+		}
+
+		/* Don't generate bad syntax if no undropped columns */
+		if (first)
+			appendStringInfoString(buf, "NULL");
+	}
+}
+
 /*
  * deparse remote UPDATE statement
  *
@@ -931,7 +1373,7 @@ deparseUpdateSql(StringInfo buf, PlannerInfo *root,
 			appendStringInfoString(buf, ", ");
 		first = false;
 
-		deparseColumnRef(buf, rtindex, attnum, root);
+		deparseColumnRef(buf, rtindex, attnum, root, false);
 		appendStringInfo(buf, " = $%d", pindex);
 		pindex++;
 	}
@@ -964,6 +1406,111 @@ deparseDeleteSql(StringInfo buf, PlannerInfo *root,
 						 returningList, retrieved_attrs);
 }
 
+/*
+ * deparse remote UPDATE statement that updates the rows directly, without
+ * fetching them first
+ *
+ * Each column in targetAttrs is set to the expression computed for it in
+ * targetlist, for the rows matching remote_conds.  The statement text is
+ * appended to buf, and the Params it uses are returned in *params_list.
+ */
+void
+deparseDirectUpdateSql(StringInfo buf, PlannerInfo *root,
+					   Index rtindex, Relation rel,
+					   RelOptInfo *foreignrel,
+					   List *targetlist,
+					   List *targetAttrs,
+					   List *remote_conds,
+					   List **params_list)
+{
+	deparse_expr_cxt context;
+	int			nestlevel;
+	bool		first;
+	ListCell   *lc;
+
+	*params_list = NIL;			/* initialize result list to empty */
+
+	/* Set up context struct for recursion */
+	context.root = root;
+	context.foreignrel = foreignrel;
+	context.buf = buf;
+	context.params_list = params_list;
+
+	appendStringInfoString(buf, "UPDATE ");
+	deparseRelation(buf, rel);
+	appendStringInfoString(buf, " SET ");
+
+	/* Make sure any constants in the exprs are printed portably */
+	nestlevel = set_transmission_modes();
+
+	first = true;
+	foreach(lc, targetAttrs)
+	{
+		int			attnum = lfirst_int(lc);
+		TargetEntry *tle = get_tle_by_resno(targetlist, attnum);
+
+		if (!tle)
+			elog(ERROR, "attribute number %d not found in UPDATE targetlist",
+				 attnum);
+
+		if (!first)
+			appendStringInfoString(buf, ", ");
+		first = false;
+
+		deparseColumnRef(buf, rtindex, attnum, root, false);
+		appendStringInfoString(buf, " = ");
+		deparseExpr(tle->expr, &context);
+	}
+
+	if (remote_conds)
+	{
+		appendStringInfoString(buf, " WHERE ");
+		appendConditions(remote_conds, &context);
+	}
+
+	reset_transmission_modes(nestlevel);
+}
+
+/*
+ * deparse remote DELETE statement that deletes the rows directly, without
+ * fetching them first
+ *
+ * The rows matching remote_conds are deleted.  The statement text is
+ * appended to buf, and the Params it uses are returned in *params_list.
+ */
+void
+deparseDirectDeleteSql(StringInfo buf, PlannerInfo *root,
+					   Index rtindex, Relation rel,
+					   RelOptInfo *foreignrel,
+					   List *remote_conds,
+					   List **params_list)
+{
+	deparse_expr_cxt context;
+	int			nestlevel;
+
+	*params_list = NIL;			/* initialize result list to empty */
+
+	/* Set up context struct for recursion */
+	context.root = root;
+	context.foreignrel = foreignrel;
+	context.buf = buf;
+	context.params_list = params_list;
+
+	appendStringInfoString(buf, "DELETE FROM ");
+	deparseRelation(buf, rel);
+
+	if (remote_conds)
+	{
+		/* Make sure any constants in the exprs are printed portably */
+		nestlevel = set_transmission_modes();
+
+		appendStringInfoString(buf, " WHERE ");
+		appendConditions(remote_conds, &context);
+
+		reset_transmission_modes(nestlevel);
+	}
+}
+
 /*
  * Add a RETURNING clause, if needed, to an INSERT/UPDATE/DELETE.
  */
@@ -1091,12 +1638,10 @@ deparseAnalyzeSql(StringInfo buf, Relation rel, List **retrieved_attrs)
  * If it has a column_name FDW option, use that instead of attribute name.
  */
 static void
-deparseColumnRef(StringInfo buf, int varno, int varattno, PlannerInfo *root)
+deparseColumnRef(StringInfo buf, int varno, int varattno, PlannerInfo *root,
+				 bool qualify_col)
 {
 	RangeTblEntry *rte;
-	char	   *colname = NULL;
-	List	   *options;
-	ListCell   *lc;
 
 	/* varno must not be any of OUTER_VAR, INNER_VAR and INDEX_VAR. */
 	Assert(!IS_SPECIAL_VARNO(varno));
@@ -1104,11 +1649,29 @@ deparseColumnRef(StringInfo buf, int varno, int varattno, PlannerInfo *root)
 	/* Get RangeTblEntry from array in PlannerInfo. */
 	rte = planner_rt_fetch(varno, root);
 
+	/* In a join, qualify the column with the alias of its table */
+	if (qualify_col)
+		appendStringInfo(buf, "%s%d.", REL_ALIAS_PREFIX, varno);
+
+	deparseAttributeName(buf, rte->relid, varattno);
+}
+
+/*
+ * Emit the name to use for the given column of the given relation into buf,
+ * as deparseColumnRef does.
+ */
+static void
+deparseAttributeName(StringInfo buf, Oid relid, int attnum)
+{
+	char	   *colname = NULL;
+	List	   *options;
+	ListCell   *lc;
+
 	/*
 	 * If it's a column of a foreign table, and it has the column_name FDW
 	 * option, use that value.
 	 */
-	options = GetForeignColumnOptions(rte->relid, varattno);
+	options = GetForeignColumnOptions(relid, attnum);
 	foreach(lc, options)
 	{
 		DefElem    *def = (DefElem *) lfirst(lc);
@@ -1125,7 +1688,7 @@ deparseColumnRef(StringInfo buf, int varno, int varattno, PlannerInfo *root)
 	 * option, use attribute name.
 	 */
 	if (colname == NULL)
-		colname = get_relid_attribute_name(rte->relid, varattno);
+		colname = get_relid_attribute_name(relid, attnum);
 
 	appendStringInfoString(buf, quote_identifier(colname));
 }
@@ -1254,6 +1817,9 @@ deparseExpr(Expr *node, deparse_expr_cxt *context)
 		case T_ArrayExpr:
 			deparseArrayExpr((ArrayExpr *) node, context);
 			break;
+		case T_Aggref:
+			deparseAggref((Aggref *) node, context);
+			break;
 		default:
 			elog(ERROR, "unsupported expression type for deparse: %d",
 				 (int) nodeTag(node));
@@ -1264,7 +1830,8 @@ deparseExpr(Expr *node, deparse_expr_cxt *context)
 /*
  * Deparse given Var node into context->buf.
  *
- * If the Var belongs to the foreign relation, just print its remote name.
+ * If the Var belongs to the foreign relation, just print its remote name,
+ * qualified with the table's alias in a join.
  * Otherwise, it's effectively a Param (and will in fact be a Param at
  * run time).  Handle it the same way we handle plain Params --- see
  * deparseParam for comments.
@@ -1274,11 +1841,12 @@ deparseVar(Var *node, deparse_expr_cxt *context)
 {
 	StringInfo	buf = context->buf;
 
-	if (node->varno == context->foreignrel->relid &&
+	if (bms_is_member(node->varno, context->foreignrel->relids) &&
 		node->varlevelsup == 0)
 	{
 		/* Var belongs to foreign table */
-		deparseColumnRef(buf, node->varno, node->varattno, context->root);
+		deparseColumnRef(buf, node->varno, node->varattno, context->root,
+						 context->foreignrel->reloptkind == RELOPT_JOINREL);
 	}
 	else
 	{
@@ -1809,6 +2377,57 @@ deparseArrayExpr(ArrayExpr *node, deparse_expr_cxt *context)
 						 format_type_with_typemod(node->array_typeid, -1));
 }
 
+/*
+ * Deparse an aggregate call.  foreign_expr_walker only lets through plain
+ * aggregates, without ORDER BY, DISTINCT or FILTER.
+ */
+static void
+deparseAggref(Aggref *node, deparse_expr_cxt *context)
+{
+	StringInfo	buf = context->buf;
+	HeapTuple	proctup;
+	Form_pg_proc procform;
+	bool		first;
+	ListCell   *arg;
+
+	proctup = SearchSysCache1(PROCOID, ObjectIdGetDatum(node->aggfnoid));
+	if (!HeapTupleIsValid(proctup))
+		elog(ERROR, "cache lookup failed for function %u", node->aggfnoid);
+	procform = (Form_pg_proc) GETSTRUCT(proctup);
+
+	/* Print schema name only if it's not pg_catalog */
+	if (procform->pronamespace != PG_CATALOG_NAMESPACE)
+	{
+		const char *schemaname;
+
+		schemaname = get_namespace_name(procform->pronamespace);
+		appendStringInfo(buf, "%s.", quote_identifier(schemaname));
+	}
+
+	appendStringInfo(buf, "%s(",
+					 quote_identifier(NameStr(procform->proname)));
+	if (node->aggstar)
+		appendStringInfoChar(buf, '*');
+	else
+	{
+		first = true;
+		foreach(arg, node->args)
+		{
+			TargetEntry *tle = (TargetEntry *) lfirst(arg);
+
+			if (!first)
+				appendStringInfoString(buf, ", ");
+			if (node->aggvariadic && lnext(arg) == NULL)
+				appendStringInfoString(buf, "VARIADIC ");
+			deparseExpr(tle->expr, context);
+			first = false;
+		}
+	}
+	appendStringInfoChar(buf, ')');
+
+	ReleaseSysCache(proctup);
+}
+
 /*
  * Print the representation of a parameter to be sent to the remote side.
  *
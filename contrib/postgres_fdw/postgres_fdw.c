@@ -16,6 +16,7 @@
 
 #include "access/htup_details.h"
 #include "access/sysattr.h"
+#include "catalog/pg_am.h"
 #include "commands/defrem.h"
 #include "commands/explain.h"
 #include "commands/vacuum.h"
@@ -24,12 +25,14 @@
 #include "miscadmin.h"
 #include "nodes/makefuncs.h"
 #include "nodes/nodeFuncs.h"
+#include "optimizer/clauses.h"
 #include "optimizer/cost.h"
 #include "optimizer/pathnode.h"
 #include "optimizer/paths.h"
 #include "optimizer/planmain.h"
 #include "optimizer/prep.h"
 #include "optimizer/restrictinfo.h"
+#include "optimizer/tlist.h"
 #include "optimizer/var.h"
 #include "parser/parsetree.h"
 #include "utils/builtins.h"
@@ -38,6 +41,7 @@
 #include "utils/memutils.h"
 #include "utils/rel.h"
 #include "utils/sampling.h"
+#include "utils/typcache.h"
 
 PG_MODULE_MAGIC;
 
@@ -48,38 +52,13 @@ PG_MODULE_MAGIC;
 #define DEFAULT_FDW_TUPLE_COST		0.01
 
 /*
- * FDW-specific planner information kept in RelOptInfo.fdw_private for a
- * foreign table.  This information is collected by postgresGetForeignRelSize.
+ * Default factor by which to increase the cost of a remote scan that sorts
+ * its rows, as we have no better idea of what the sort costs.
  */
-typedef struct PgFdwRelationInfo
-{
-	/* baserestrictinfo clauses, broken down into safe and unsafe subsets. */
-	List	   *remote_conds;
-	List	   *local_conds;
-
-	/* Bitmap of attr numbers we need to fetch from the remote server. */
-	Bitmapset  *attrs_used;
-
-	/* Cost and selectivity of local_conds. */
-	QualCost	local_conds_cost;
-	Selectivity local_conds_sel;
-
-	/* Estimated size and cost for a scan with baserestrictinfo quals. */
-	double		rows;
-	int			width;
-	Cost		startup_cost;
-	Cost		total_cost;
-
-	/* Options extracted from catalogs. */
-	bool		use_remote_estimate;
-	Cost		fdw_startup_cost;
-	Cost		fdw_tuple_cost;
+#define DEFAULT_FDW_SORT_MULTIPLIER 1.2
 
-	/* Cached catalog information. */
-	ForeignTable *table;
-	ForeignServer *server;
-	UserMapping *user;			/* only set in use_remote_estimate mode */
-} PgFdwRelationInfo;
+/* Default number of rows to fetch at a time. */
+#define DEFAULT_FETCH_SIZE			100
 
 /*
  * Indexes of FDW-private information stored in fdw_private lists.
@@ -89,6 +68,9 @@ typedef struct PgFdwRelationInfo
  *
  * 1) SELECT statement text to be sent to the remote server
  * 2) Integer list of attribute numbers retrieved by the SELECT
+ * 3) Number of rows to fetch at a time
+ * 4) Conditions in the remote WHERE clause of a foreign table scan, as bare
+ *	  expressions, for postgresPlanDirectModify (NIL for a join or grouping)
  *
  * These items are indexed with the enum FdwScanPrivateIndex, so an item
  * can be fetched with list_nth().  For example, to get the SELECT statement:
@@ -99,7 +81,11 @@ enum FdwScanPrivateIndex
 	/* SQL statement to execute remotely (as a String node) */
 	FdwScanPrivateSelectSql,
 	/* Integer list of attribute numbers retrieved by the SELECT */
-	FdwScanPrivateRetrievedAttrs
+	FdwScanPrivateRetrievedAttrs,
+	/* Fetch size (as an integer Value node) */
+	FdwScanPrivateFetchSize,
+	/* List of remote conditions of a foreign table scan */
+	FdwScanPrivateRemoteConds
 };
 
 /*
@@ -124,12 +110,28 @@ enum FdwModifyPrivateIndex
 	FdwModifyPrivateRetrievedAttrs
 };
 
+/*
+ * And this one describes the fdw_private list of a ForeignScan that
+ * updates or deletes the rows of a foreign table directly:
+ *
+ * 1) UPDATE/DELETE statement text to be sent to the remote server
+ * 2) Boolean flag showing if we set the command es_processed
+ */
+enum FdwDirectModifyPrivateIndex
+{
+	/* SQL statement to execute remotely (as a String node) */
+	FdwDirectModifyPrivateUpdateSql,
+	/* set-processed flag (as an integer Value node) */
+	FdwDirectModifyPrivateSetProcessed
+};
+
 /*
  * Execution state of a foreign scan using postgres_fdw.
  */
 typedef struct PgFdwScanState
 {
-	Relation	rel;			/* relcache entry for the foreign table */
+	Relation	rel;			/* relcache entry for the foreign table, or
+								 * NULL for a join or aggregation */
 	AttInMetadata *attinmeta;	/* attribute datatype conversion metadata */
 
 	/* extracted fdw_private data */
@@ -151,11 +153,25 @@ typedef struct PgFdwScanState
 	int			next_tuple;		/* index of next one to return */
 
 	/* batch-level state, for optimizing rewinds and avoiding useless fetch */
+	int			fetch_size;		/* # of rows to fetch at a time */
 	int			fetch_ct_2;		/* Min(# of fetches done, 2) */
 	bool		eof_reached;	/* true if last fetch reached EOF */
 
+	/*
+	 * For asynchronous execution, the FETCH for the next batch is sent
+	 * before the current one is used up, and its result may be received
+	 * before it's needed, see send_fetch_request and receive_fetch_result.
+	 */
+	bool		async_capable;	/* may we run asynchronously under Append? */
+	bool		fetch_in_progress;	/* FETCH sent, result not received? */
+	bool		fetch_received; /* result received, not yet current batch? */
+	HeapTuple  *fetched_tuples; /* the received tuples */
+	int			num_fetched;	/* # of tuples in fetched_tuples */
+	bool		fetched_eof;	/* true if the received FETCH reached EOF */
+
 	/* working memory contexts */
 	MemoryContext batch_cxt;	/* context holding current batch of tuples */
+	MemoryContext fetch_cxt;	/* context holding received batch */
 	MemoryContext temp_cxt;		/* context for per-tuple temporary data */
 } PgFdwScanState;
 
@@ -182,10 +198,42 @@ typedef struct PgFdwModifyState
 	int			p_nums;			/* number of parameters to transmit */
 	FmgrInfo   *p_flinfo;		/* output conversion functions for them */
 
+	/* for batched inserts, see postgresExecForeignBatchInsert */
+	char	   *batch_p_name;	/* name of multi-row INSERT, if prepared */
+	int			batch_nrows;	/* number of rows it inserts */
+
 	/* working memory context */
 	MemoryContext temp_cxt;		/* context for per-tuple temporary data */
 } PgFdwModifyState;
 
+/*
+ * Execution state of a foreign update/delete done directly on the remote
+ * server, by a ForeignScan.
+ */
+typedef struct PgFdwDirectModifyState
+{
+	Relation	rel;			/* relcache entry for the foreign table */
+
+	/* extracted fdw_private data */
+	char	   *query;			/* text of UPDATE/DELETE command */
+	bool		set_processed;	/* do we set the command es_processed? */
+
+	/* for remote query execution */
+	PGconn	   *conn;			/* connection for the update */
+	int			numParams;		/* number of parameters passed to query */
+	FmgrInfo   *param_flinfo;	/* output conversion functions for them */
+	List	   *param_exprs;	/* executable expressions for param values */
+	const char **param_values;	/* textual values of query parameters */
+
+	bool		done;			/* have we run the command yet? */
+} PgFdwDirectModifyState;
+
+/*
+ * The protocol allows at most this many parameters for a statement, which
+ * limits the number of rows we can send in one multi-row INSERT.
+ */
+#define MAX_BATCH_INSERT_PARAMS		65535
+
 /*
  * Workspace for analyzing a foreign table.
  */
@@ -215,7 +263,7 @@ typedef struct PgFdwAnalyzeState
  */
 typedef struct ConversionLocation
 {
-	Relation	rel;			/* foreign table's relcache entry */
+	Relation	rel;			/* foreign table's relcache entry, or NULL */
 	AttrNumber	cur_attno;		/* attribute number being processed, or 0 */
 } ConversionLocation;
 
@@ -241,15 +289,28 @@ static void postgresGetForeignPaths(PlannerInfo *root,
 						RelOptInfo *baserel,
 						Oid foreigntableid);
 static ForeignScan *postgresGetForeignPlan(PlannerInfo *root,
-					   RelOptInfo *baserel,
+					   RelOptInfo *foreignrel,
 					   Oid foreigntableid,
 					   ForeignPath *best_path,
 					   List *tlist,
 					   List *scan_clauses);
+static void postgresGetForeignJoinPaths(PlannerInfo *root,
+							RelOptInfo *joinrel,
+							RelOptInfo *outerrel,
+							RelOptInfo *innerrel,
+							JoinType jointype,
+							JoinPathExtraData *extra);
+static ForeignScan *postgresGetForeignUpperPlan(PlannerInfo *root,
+							RelOptInfo *input_rel,
+							List *tlist,
+							double num_groups);
 static void postgresBeginForeignScan(ForeignScanState *node, int eflags);
 static TupleTableSlot *postgresIterateForeignScan(ForeignScanState *node);
 static void postgresReScanForeignScan(ForeignScanState *node);
 static void postgresEndForeignScan(ForeignScanState *node);
+static bool postgresIsForeignScanAsyncCapable(ForeignScanState *node);
+static bool postgresForeignAsyncReady(ForeignScanState *node,
+						  pgsocket *waitsock);
 static void postgresAddForeignUpdateTargets(Query *parsetree,
 								RangeTblEntry *target_rte,
 								Relation target_relation);
@@ -277,6 +338,24 @@ static TupleTableSlot *postgresExecForeignDelete(EState *estate,
 static void postgresEndForeignModify(EState *estate,
 						 ResultRelInfo *resultRelInfo);
 static int	postgresIsForeignRelUpdatable(Relation rel);
+static void postgresBeginForeignInsert(EState *estate,
+						   ResultRelInfo *resultRelInfo);
+static int postgresExecForeignBatchInsert(EState *estate,
+							   ResultRelInfo *resultRelInfo,
+							   TupleTableSlot **slots,
+							   int nslots);
+static void postgresEndForeignInsert(EState *estate,
+						 ResultRelInfo *resultRelInfo);
+static int	postgresGetForeignModifyBatchSize(ResultRelInfo *resultRelInfo);
+static bool postgresPlanDirectModify(PlannerInfo *root,
+						 ModifyTable *plan,
+						 Index resultRelation,
+						 int subplan_index);
+static void postgresBeginDirectModify(ForeignScanState *node, int eflags);
+static TupleTableSlot *postgresIterateDirectModify(ForeignScanState *node);
+static void postgresEndDirectModify(ForeignScanState *node);
+static void postgresExplainDirectModify(ForeignScanState *node,
+							ExplainState *es);
 static void postgresExplainForeignScan(ForeignScanState *node,
 						   ExplainState *es);
 static void postgresExplainForeignModify(ModifyTableState *mtstate,
@@ -294,8 +373,10 @@ static List *postgresImportForeignSchema(ImportForeignSchemaStmt *stmt,
  * Helper functions
  */
 static void estimate_path_cost_size(PlannerInfo *root,
-						RelOptInfo *baserel,
+						RelOptInfo *foreignrel,
 						List *join_conds,
+						List *pathkeys,
+						double limit_tuples,
 						double *p_rows, int *p_width,
 						Cost *p_startup_cost, Cost *p_total_cost);
 static void get_remote_estimate(const char *sql,
@@ -307,8 +388,33 @@ static void get_remote_estimate(const char *sql,
 static bool ec_member_matches_foreign(PlannerInfo *root, RelOptInfo *rel,
 						  EquivalenceClass *ec, EquivalenceMember *em,
 						  void *arg);
+static int	get_fetch_size(ForeignServer *server, ForeignTable *table);
+static int	get_batch_size(ForeignServer *server, ForeignTable *table);
+static List *get_useful_pathkeys_for_relation(PlannerInfo *root,
+								 RelOptInfo *rel);
+static bool limit_pushdown_ok(PlannerInfo *root, RelOptInfo *rel);
+static void add_paths_with_pathkeys_for_rel(PlannerInfo *root,
+								RelOptInfo *rel);
+static bool foreign_join_ok(PlannerInfo *root, RelOptInfo *joinrel,
+				JoinType jointype, RelOptInfo *outerrel,
+				RelOptInfo *innerrel, JoinPathExtraData *extra);
+static List *build_tlist_to_deparse(RelOptInfo *foreignrel);
+static void prepare_query_params(PlanState *node,
+					 List *fdw_exprs,
+					 int numParams,
+					 FmgrInfo **param_flinfo,
+					 List **param_exprs,
+					 const char ***param_values);
+static void process_query_params(ExprContext *econtext,
+					 FmgrInfo *param_flinfo,
+					 List *param_exprs,
+					 const char **values);
 static void create_cursor(ForeignScanState *node);
 static void fetch_more_data(ForeignScanState *node);
+static void send_fetch_request(ForeignScanState *node);
+static void receive_fetch_result(ForeignScanState *node);
+static void complete_pending_fetch(void *arg);
+static void abandon_fetch(PgFdwScanState *fsstate);
 static void close_cursor(PGconn *conn, unsigned int cursor_number);
 static void prepare_foreign_modify(PgFdwModifyState *fmstate);
 static const char **convert_prep_stmt_params(PgFdwModifyState *fmstate,
@@ -349,6 +455,10 @@ postgres_fdw_handler(PG_FUNCTION_ARGS)
 	routine->ReScanForeignScan = postgresReScanForeignScan;
 	routine->EndForeignScan = postgresEndForeignScan;
 
+	/* Functions for remote joins and aggregation */
+	routine->GetForeignJoinPaths = postgresGetForeignJoinPaths;
+	routine->GetForeignUpperPlan = postgresGetForeignUpperPlan;
+
 	/* Functions for updating foreign tables */
 	routine->AddForeignUpdateTargets = postgresAddForeignUpdateTargets;
 	routine->PlanForeignModify = postgresPlanForeignModify;
@@ -358,10 +468,21 @@ postgres_fdw_handler(PG_FUNCTION_ARGS)
 	routine->ExecForeignDelete = postgresExecForeignDelete;
 	routine->EndForeignModify = postgresEndForeignModify;
 	routine->IsForeignRelUpdatable = postgresIsForeignRelUpdatable;
+	routine->GetForeignModifyBatchSize = postgresGetForeignModifyBatchSize;
+	routine->PlanDirectModify = postgresPlanDirectModify;
+	routine->BeginDirectModify = postgresBeginDirectModify;
+	routine->IterateDirectModify = postgresIterateDirectModify;
+	routine->EndDirectModify = postgresEndDirectModify;
+
+	/* Functions for COPY FROM into foreign tables, and batched inserts */
+	routine->BeginForeignInsert = postgresBeginForeignInsert;
+	routine->ExecForeignBatchInsert = postgresExecForeignBatchInsert;
+	routine->EndForeignInsert = postgresEndForeignInsert;
 
 	/* Support functions for EXPLAIN */
 	routine->ExplainForeignScan = postgresExplainForeignScan;
 	routine->ExplainForeignModify = postgresExplainForeignModify;
+	routine->ExplainDirectModify = postgresExplainDirectModify;
 
 	/* Support functions for ANALYZE */
 	routine->AnalyzeForeignTable = postgresAnalyzeForeignTable;
@@ -369,6 +490,10 @@ postgres_fdw_handler(PG_FUNCTION_ARGS)
 	/* Support functions for IMPORT FOREIGN SCHEMA */
 	routine->ImportForeignSchema = postgresImportForeignSchema;
 
+	/* Functions for asynchronous execution under Append */
+	routine->IsForeignScanAsyncCapable = postgresIsForeignScanAsyncCapable;
+	routine->ForeignAsyncReady = postgresForeignAsyncReady;
+
 	PG_RETURN_POINTER(routine);
 }
 
@@ -385,6 +510,7 @@ postgresGetForeignRelSize(PlannerInfo *root,
 						  Oid foreigntableid)
 {
 	PgFdwRelationInfo *fpinfo;
+	RangeTblEntry *rte;
 	ListCell   *lc;
 
 	/*
@@ -394,6 +520,9 @@ postgresGetForeignRelSize(PlannerInfo *root,
 	fpinfo = (PgFdwRelationInfo *) palloc0(sizeof(PgFdwRelationInfo));
 	baserel->fdw_private = (void *) fpinfo;
 
+	/* A scan of a foreign table can always be done remotely */
+	fpinfo->pushdown_safe = true;
+
 	/* Look up foreign-table catalog info. */
 	fpinfo->table = GetForeignTable(foreigntableid);
 	fpinfo->server = GetForeignServer(fpinfo->table->serverid);
@@ -427,20 +556,20 @@ postgresGetForeignRelSize(PlannerInfo *root,
 			break;				/* only need the one value */
 		}
 	}
+	fpinfo->fetch_size = get_fetch_size(fpinfo->server, fpinfo->table);
 
 	/*
-	 * If the table or the server is configured to use remote estimates,
-	 * identify which user to do remote access as during planning.  This
-	 * should match what ExecCheckRTEPerms() does.  If we fail due to lack of
-	 * permissions, the query would have failed at runtime anyway.
+	 * Identify which user to do remote access as.  This should match what
+	 * ExecCheckRTEPerms() does.  We need it to tell whether joins with other
+	 * foreign tables can be pushed down, and if the table or the server is
+	 * configured to use remote estimates, we look up the user mapping for
+	 * use during planning.  If we fail due to lack of permissions, the query
+	 * would have failed at runtime anyway.
 	 */
+	rte = planner_rt_fetch(baserel->relid, root);
+	fpinfo->userid = rte->checkAsUser ? rte->checkAsUser : GetUserId();
 	if (fpinfo->use_remote_estimate)
-	{
-		RangeTblEntry *rte = planner_rt_fetch(baserel->relid, root);
-		Oid			userid = rte->checkAsUser ? rte->checkAsUser : GetUserId();
-
-		fpinfo->user = GetUserMapping(userid, fpinfo->server->serverid);
-	}
+		fpinfo->user = GetUserMapping(fpinfo->userid, fpinfo->server->serverid);
 	else
 		fpinfo->user = NULL;
 
@@ -497,7 +626,7 @@ postgresGetForeignRelSize(PlannerInfo *root,
 		 * values in fpinfo so we don't need to do it again to generate the
 		 * basic foreign path.
 		 */
-		estimate_path_cost_size(root, baserel, NIL,
+		estimate_path_cost_size(root, baserel, NIL, NIL, -1.0,
 								&fpinfo->rows, &fpinfo->width,
 								&fpinfo->startup_cost, &fpinfo->total_cost);
 
@@ -527,7 +656,7 @@ postgresGetForeignRelSize(PlannerInfo *root,
 		set_baserel_size_estimates(root, baserel);
 
 		/* Fill in basically-bogus cost estimates for use later. */
-		estimate_path_cost_size(root, baserel, NIL,
+		estimate_path_cost_size(root, baserel, NIL, NIL, -1.0,
 								&fpinfo->rows, &fpinfo->width,
 								&fpinfo->startup_cost, &fpinfo->total_cost);
 	}
@@ -563,6 +692,9 @@ postgresGetForeignPaths(PlannerInfo *root,
 								   NIL);		/* no fdw_private list */
 	add_path(baserel, (Path *) path);
 
+	/* Add a path sorted remotely, and one applying the LIMIT, if useful */
+	add_paths_with_pathkeys_for_rel(root, baserel);
+
 	/*
 	 * If we're not using remote estimates, stop here.  We have no way to
 	 * estimate whether any join clauses would be worth sending across, so
@@ -710,7 +842,7 @@ postgresGetForeignPaths(PlannerInfo *root,
 
 		/* Get a cost estimate from the remote */
 		estimate_path_cost_size(root, baserel,
-								param_info->ppi_clauses,
+								param_info->ppi_clauses, NIL, -1.0,
 								&rows, &width,
 								&startup_cost, &total_cost);
 
@@ -738,92 +870,117 @@ postgresGetForeignPaths(PlannerInfo *root,
  */
 static ForeignScan *
 postgresGetForeignPlan(PlannerInfo *root,
-					   RelOptInfo *baserel,
+					   RelOptInfo *foreignrel,
 					   Oid foreigntableid,
 					   ForeignPath *best_path,
 					   List *tlist,
 					   List *scan_clauses)
 {
-	PgFdwRelationInfo *fpinfo = (PgFdwRelationInfo *) baserel->fdw_private;
-	Index		scan_relid = baserel->relid;
+	PgFdwRelationInfo *fpinfo = (PgFdwRelationInfo *) foreignrel->fdw_private;
+	Index		scan_relid;
 	List	   *fdw_private;
 	List	   *remote_conds = NIL;
 	List	   *local_exprs = NIL;
 	List	   *params_list = NIL;
+	List	   *fdw_scan_tlist = NIL;
 	List	   *retrieved_attrs;
+	double		limit_tuples = -1.0;
 	StringInfoData sql;
 	ListCell   *lc;
 
-	/*
-	 * Separate the scan_clauses into those that can be executed remotely and
-	 * those that can't.  baserestrictinfo clauses that were previously
-	 * determined to be safe or unsafe by classifyConditions are shown in
-	 * fpinfo->remote_conds and fpinfo->local_conds.  Anything else in the
-	 * scan_clauses list will be a join clause, which we have to check for
-	 * remote-safety.
-	 *
-	 * Note: the join clauses we see here should be the exact same ones
-	 * previously examined by postgresGetForeignPaths.  Possibly it'd be worth
-	 * passing forward the classification work done then, rather than
-	 * repeating it here.
-	 *
-	 * This code must match "extract_actual_clauses(scan_clauses, false)"
-	 * except for the additional decision about remote versus local execution.
-	 * Note however that we only strip the RestrictInfo nodes from the
-	 * local_exprs list, since appendWhereClause expects a list of
-	 * RestrictInfos.
-	 */
-	foreach(lc, scan_clauses)
+	if (foreignrel->reloptkind == RELOPT_JOINREL)
 	{
-		RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+		/*
+		 * For a join, foreign_join_ok found all the conditions safe to send
+		 * to the remote server; those not used in the ON clauses go into the
+		 * WHERE clause.  scan_clauses is always empty for a join.
+		 */
+		scan_relid = 0;
+		remote_conds = fpinfo->remote_conds;
+
+		/* The scan returns the columns the join has to supply, in order */
+		fdw_scan_tlist = build_tlist_to_deparse(foreignrel);
+	}
+	else
+	{
+		scan_relid = foreignrel->relid;
 
-		Assert(IsA(rinfo, RestrictInfo));
+		/*
+		 * Separate the scan_clauses into those that can be executed remotely
+		 * and those that can't.  baserestrictinfo clauses that were
+		 * previously determined to be safe or unsafe by classifyConditions
+		 * are shown in fpinfo->remote_conds and fpinfo->local_conds.
+		 * Anything else in the scan_clauses list will be a join clause,
+		 * which we have to check for remote-safety.
+		 *
+		 * Note: the join clauses we see here should be the exact same ones
+		 * previously examined by postgresGetForeignPaths.  Possibly it'd be
+		 * worth passing forward the classification work done then, rather
+		 * than repeating it here.
+		 *
+		 * This code must match "extract_actual_clauses(scan_clauses, false)"
+		 * except for the additional decision about remote versus local
+		 * execution.  Note however that we only strip the RestrictInfo nodes
+		 * from the local_exprs list, since deparseSelectStmtForRel expects a
+		 * list of RestrictInfos.
+		 */
+		foreach(lc, scan_clauses)
+		{
+			RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
 
-		/* Ignore any pseudoconstants, they're dealt with elsewhere */
-		if (rinfo->pseudoconstant)
-			continue;
+			Assert(IsA(rinfo, RestrictInfo));
 
-		if (list_member_ptr(fpinfo->remote_conds, rinfo))
-			remote_conds = lappend(remote_conds, rinfo);
-		else if (list_member_ptr(fpinfo->local_conds, rinfo))
-			local_exprs = lappend(local_exprs, rinfo->clause);
-		else if (is_foreign_expr(root, baserel, rinfo->clause))
-			remote_conds = lappend(remote_conds, rinfo);
-		else
-			local_exprs = lappend(local_exprs, rinfo->clause);
+			/* Ignore any pseudoconstants, they're dealt with elsewhere */
+			if (rinfo->pseudoconstant)
+				continue;
+
+			if (list_member_ptr(fpinfo->remote_conds, rinfo))
+				remote_conds = lappend(remote_conds, rinfo);
+			else if (list_member_ptr(fpinfo->local_conds, rinfo))
+				local_exprs = lappend(local_exprs, rinfo->clause);
+			else if (is_foreign_expr(root, foreignrel, rinfo->clause))
+				remote_conds = lappend(remote_conds, rinfo);
+			else
+				local_exprs = lappend(local_exprs, rinfo->clause);
+		}
 	}
 
+	/* Apply the query's LIMIT remotely if the path says so */
+	if (best_path->fdw_private != NIL &&
+		intVal(linitial(best_path->fdw_private)))
+		limit_tuples = root->limit_tuples;
+
 	/*
 	 * Build the query string to be sent for execution, and identify
 	 * expressions to be sent as parameters.
 	 */
 	initStringInfo(&sql);
-	deparseSelectSql(&sql, root, baserel, fpinfo->attrs_used,
-					 &retrieved_attrs);
-	if (remote_conds)
-		appendWhereClause(&sql, root, baserel, remote_conds,
-						  true, &params_list);
+	deparseSelectStmtForRel(&sql, root, foreignrel, fdw_scan_tlist,
+							remote_conds, best_path->path.pathkeys,
+							limit_tuples, &retrieved_attrs, &params_list);
 
 	/*
 	 * Add FOR UPDATE/SHARE if appropriate.  We apply locking during the
 	 * initial row fetch, rather than later on as is done for local tables.
 	 * The extra roundtrips involved in trying to duplicate the local
 	 * semantics exactly don't seem worthwhile (see also comments for
-	 * RowMarkType).
+	 * RowMarkType).  Joins are never pushed down if there's any locking.
 	 *
 	 * Note: because we actually run the query as a cursor, this assumes that
 	 * DECLARE CURSOR ... FOR UPDATE is supported, which it isn't before 8.3.
 	 */
-	if (baserel->relid == root->parse->resultRelation &&
-		(root->parse->commandType == CMD_UPDATE ||
-		 root->parse->commandType == CMD_DELETE))
+	if (scan_relid == 0)
+		 /* join, no locking */ ;
+	else if (scan_relid == root->parse->resultRelation &&
+			 (root->parse->commandType == CMD_UPDATE ||
+			  root->parse->commandType == CMD_DELETE))
 	{
 		/* Relation is UPDATE/DELETE target, so use FOR UPDATE */
 		appendStringInfoString(&sql, " FOR UPDATE");
 	}
 	else
 	{
-		PlanRowMark *rc = get_plan_rowmark(root->rowMarks, baserel->relid);
+		PlanRowMark *rc = get_plan_rowmark(root->rowMarks, scan_relid);
 
 		if (rc)
 		{
@@ -858,8 +1015,12 @@ postgresGetForeignPlan(PlannerInfo *root,
 	 * Build the fdw_private list that will be available to the executor.
 	 * Items in the list must match enum FdwScanPrivateIndex, above.
 	 */
-	fdw_private = list_make2(makeString(sql.data),
-							 retrieved_attrs);
+	fdw_private = list_make4(makeString(sql.data),
+							 retrieved_attrs,
+							 makeInteger(fpinfo->fetch_size),
+							 scan_relid > 0 ?
+							 extract_actual_clauses(remote_conds, false) :
+							 NIL);
 
 	/*
 	 * Create the ForeignScan node from target list, local filtering
@@ -874,7 +1035,220 @@ postgresGetForeignPlan(PlannerInfo *root,
 							scan_relid,
 							params_list,
 							fdw_private,
-							NIL /* no custom tlist */ );
+							fdw_scan_tlist);
+}
+
+/*
+ * postgresGetForeignJoinPaths
+ *		Add a path for doing the join of outerrel and innerrel remotely,
+ *		if all the tables involved are foreign tables on the same server
+ */
+static void
+postgresGetForeignJoinPaths(PlannerInfo *root,
+							RelOptInfo *joinrel,
+							RelOptInfo *outerrel,
+							RelOptInfo *innerrel,
+							JoinType jointype,
+							JoinPathExtraData *extra)
+{
+	PgFdwRelationInfo *fpinfo;
+	ForeignPath *joinpath;
+	double		rows;
+	int			width;
+	Cost		startup_cost;
+	Cost		total_cost;
+
+	/*
+	 * Skip if this join has been considered already, when joining another
+	 * pair of its inputs.  The first pair decides.
+	 */
+	if (joinrel->fdw_private)
+		return;
+
+	/*
+	 * Create the PgFdwRelationInfo even if the join can't be pushed down, so
+	 * that joins including this one know it can't either.
+	 */
+	fpinfo = (PgFdwRelationInfo *) palloc0(sizeof(PgFdwRelationInfo));
+	fpinfo->pushdown_safe = false;
+	joinrel->fdw_private = fpinfo;
+
+	if (!foreign_join_ok(root, joinrel, jointype, outerrel, innerrel, extra))
+		return;
+
+	/* Estimate the cost of the remote join, and add the path */
+	estimate_path_cost_size(root, joinrel, NIL, NIL, -1.0,
+							&rows, &width, &startup_cost, &total_cost);
+	fpinfo->rows = rows;
+	fpinfo->width = width;
+	fpinfo->startup_cost = startup_cost;
+	fpinfo->total_cost = total_cost;
+
+	joinpath = create_foreignscan_path(root, joinrel,
+									   rows,
+									   startup_cost,
+									   total_cost,
+									   NIL,		/* no pathkeys */
+									   NULL,	/* no required_outer */
+									   NIL);	/* no fdw_private list */
+	add_path(joinrel, (Path *) joinpath);
+
+	/* Add a path sorted remotely, and one applying the LIMIT, if useful */
+	add_paths_with_pathkeys_for_rel(root, joinrel);
+}
+
+/*
+ * postgresGetForeignUpperPlan
+ *		Create a ForeignScan plan node computing the query's aggregates and
+ *		grouping remotely, if possible
+ *
+ * input_rel covers the query's whole FROM list, and is a foreign table or a
+ * join pushed down by postgresGetForeignJoinPaths.  tlist is the query's
+ * final target list.
+ */
+static ForeignScan *
+postgresGetForeignUpperPlan(PlannerInfo *root,
+							RelOptInfo *input_rel,
+							List *tlist,
+							double num_groups)
+{
+	Query	   *parse = root->parse;
+	PgFdwRelationInfo *fpinfo = (PgFdwRelationInfo *) input_rel->fdw_private;
+	List	   *having_quals = (List *) parse->havingQual;
+	ForeignScan *fscan;
+	List	   *fdw_private;
+	List	   *params_list;
+	List	   *retrieved_attrs;
+	StringInfoData sql;
+	double		rows;
+	int			width;
+	Cost		startup_cost;
+	Cost		total_cost;
+	ListCell   *lc;
+
+	/*
+	 * The input must be scanned remotely, with all its conditions checked
+	 * there.  Pseudoconstant quals are applied above the scan, so they'd be
+	 * applied to the aggregated result, which would be wrong.
+	 */
+	if (fpinfo == NULL || !fpinfo->pushdown_safe ||
+		fpinfo->local_conds != NIL || root->hasPseudoConstantQuals)
+		return NULL;
+
+	/* The target list and the HAVING quals must be computable remotely */
+	foreach(lc, tlist)
+	{
+		TargetEntry *tle = (TargetEntry *) lfirst(lc);
+
+		if (!is_foreign_grouping_expr(root, input_rel, tle->expr))
+			return NULL;
+	}
+	foreach(lc, having_quals)
+	{
+		if (!is_foreign_grouping_expr(root, input_rel, (Expr *) lfirst(lc)))
+			return NULL;
+	}
+
+	/*
+	 * GROUP BY on the remote server uses the default equality operator of
+	 * each grouping column's type, so the query must do the same.
+	 */
+	foreach(lc, parse->groupClause)
+	{
+		SortGroupClause *grp = (SortGroupClause *) lfirst(lc);
+		TargetEntry *tle = get_sortgroupclause_tle(grp, tlist);
+		TypeCacheEntry *typentry;
+
+		typentry = lookup_type_cache(exprType((Node *) tle->expr),
+									 TYPECACHE_EQ_OPR);
+		if (grp->eqop != typentry->eq_opr)
+			return NULL;
+	}
+
+	/*
+	 * Build the query string to be sent for execution, and identify
+	 * expressions to be sent as parameters.
+	 */
+	initStringInfo(&sql);
+	deparseSelectStmtForGrouping(&sql, root, input_rel, tlist,
+								 fpinfo->remote_conds, having_quals,
+								 &retrieved_attrs, &params_list);
+
+	/* Estimate the cost, remotely if so configured */
+	if (fpinfo->use_remote_estimate)
+	{
+		StringInfoData explain;
+		List	   *explain_attrs;
+		PGconn	   *conn;
+
+		initStringInfo(&explain);
+		appendStringInfoString(&explain, "EXPLAIN ");
+		deparseSelectStmtForGrouping(&explain, root, input_rel, tlist,
+									 fpinfo->remote_conds, having_quals,
+									 &explain_attrs, NULL);
+
+		conn = GetConnection(fpinfo->server, fpinfo->user, false);
+		get_remote_estimate(explain.data, conn, &rows, &width,
+							&startup_cost, &total_cost);
+		ReleaseConnection(conn);
+	}
+	else
+	{
+		AggClauseCosts aggcosts;
+		double		input_rows = fpinfo->rows;
+
+		MemSet(&aggcosts, 0, sizeof(AggClauseCosts));
+		count_agg_clauses(root, (Node *) tlist, &aggcosts);
+		count_agg_clauses(root, (Node *) having_quals, &aggcosts);
+
+		rows = clamp_row_est(num_groups);
+		width = 0;
+		foreach(lc, tlist)
+		{
+			TargetEntry *tle = (TargetEntry *) lfirst(lc);
+
+			width += get_typavgwidth(exprType((Node *) tle->expr),
+									 exprTypmod((Node *) tle->expr));
+		}
+
+		/*
+		 * Cost the remote aggregation like a local one: all the input is
+		 * read and aggregated before the first group comes out.
+		 */
+		startup_cost = fpinfo->rel_total_cost;
+		startup_cost += aggcosts.transCost.startup;
+		startup_cost += aggcosts.transCost.per_tuple * input_rows;
+		startup_cost += cpu_operator_cost *
+			list_length(parse->groupClause) * input_rows;
+		total_cost = startup_cost + (aggcosts.finalCost + cpu_tuple_cost) * rows;
+	}
+
+	/* Add the overhead of the connection and of transferring the groups */
+	startup_cost += fpinfo->fdw_startup_cost;
+	total_cost += fpinfo->fdw_startup_cost;
+	total_cost += (fpinfo->fdw_tuple_cost + cpu_tuple_cost) * rows;
+
+	fdw_private = list_make4(makeString(sql.data),
+							 retrieved_attrs,
+							 makeInteger(fpinfo->fetch_size),
+							 NIL);
+
+	/*
+	 * The remote query returns exactly the target list, so the scan tuple
+	 * has its columns, and the plan's tlist just refers to them.
+	 */
+	fscan = make_foreignscan((List *) copyObject(tlist),
+							 NIL,
+							 0,
+							 params_list,
+							 fdw_private,
+							 (List *) copyObject(tlist));
+	fscan->scan.plan.startup_cost = startup_cost;
+	fscan->scan.plan.total_cost = total_cost;
+	fscan->scan.plan.plan_rows = rows;
+	fscan->scan.plan.plan_width = width;
+
+	return fscan;
 }
 
 /*
@@ -887,13 +1261,13 @@ postgresBeginForeignScan(ForeignScanState *node, int eflags)
 	ForeignScan *fsplan = (ForeignScan *) node->ss.ps.plan;
 	EState	   *estate = node->ss.ps.state;
 	PgFdwScanState *fsstate;
+	Index		rtindex;
 	RangeTblEntry *rte;
 	Oid			userid;
 	ForeignTable *table;
 	ForeignServer *server;
 	UserMapping *user;
 	int			numParams;
-	int			i;
 	ListCell   *lc;
 
 	/*
@@ -910,15 +1284,28 @@ postgresBeginForeignScan(ForeignScanState *node, int eflags)
 
 	/*
 	 * Identify which user to do the remote access as.  This should match what
-	 * ExecCheckRTEPerms() does.
+	 * ExecCheckRTEPerms() does.  For a join or aggregation, scanrelid is 0;
+	 * all the tables involved are checked as the same user, so use the first.
 	 */
-	rte = rt_fetch(fsplan->scan.scanrelid, estate->es_range_table);
+	if (fsplan->scan.scanrelid > 0)
+		rtindex = fsplan->scan.scanrelid;
+	else
+		rtindex = bms_next_member(fsplan->fs_relids, -1);
+	rte = exec_rt_fetch(rtindex, estate);
 	userid = rte->checkAsUser ? rte->checkAsUser : GetUserId();
 
-	/* Get info about foreign table. */
-	fsstate->rel = node->ss.ss_currentRelation;
-	table = GetForeignTable(RelationGetRelid(fsstate->rel));
-	server = GetForeignServer(table->serverid);
+	/* Get info about foreign table, if there's just one. */
+	if (fsplan->scan.scanrelid > 0)
+	{
+		fsstate->rel = node->ss.ss_currentRelation;
+		table = GetForeignTable(RelationGetRelid(fsstate->rel));
+	}
+	else
+	{
+		fsstate->rel = NULL;
+		table = NULL;
+	}
+	server = GetForeignServer(fsplan->fs_server);
 	user = GetUserMapping(userid, server->serverid);
 
 	/*
@@ -931,11 +1318,36 @@ postgresBeginForeignScan(ForeignScanState *node, int eflags)
 	fsstate->cursor_number = GetCursorNumber(fsstate->conn);
 	fsstate->cursor_exists = false;
 
+	/*
+	 * Run asynchronously if asked to.  The per-table setting overrides the
+	 * per-server one.
+	 */
+	fsstate->async_capable = false;
+	foreach(lc, server->options)
+	{
+		DefElem    *def = (DefElem *) lfirst(lc);
+
+		if (strcmp(def->defname, "async_capable") == 0)
+			fsstate->async_capable = defGetBoolean(def);
+	}
+	if (table)
+	{
+		foreach(lc, table->options)
+		{
+			DefElem    *def = (DefElem *) lfirst(lc);
+
+			if (strcmp(def->defname, "async_capable") == 0)
+				fsstate->async_capable = defGetBoolean(def);
+		}
+	}
+
 	/* Get private info created by planner functions. */
 	fsstate->query = strVal(list_nth(fsplan->fdw_private,
 									 FdwScanPrivateSelectSql));
 	fsstate->retrieved_attrs = (List *) list_nth(fsplan->fdw_private,
 											   FdwScanPrivateRetrievedAttrs);
+	fsstate->fetch_size = intVal(list_nth(fsplan->fdw_private,
+										  FdwScanPrivateFetchSize));
 
 	/* Create contexts for batches of tuples and per-tuple temp workspace. */
 	fsstate->batch_cxt = AllocSetContextCreate(estate->es_query_cxt,
@@ -943,51 +1355,40 @@ postgresBeginForeignScan(ForeignScanState *node, int eflags)
 											   ALLOCSET_DEFAULT_MINSIZE,
 											   ALLOCSET_DEFAULT_INITSIZE,
 											   ALLOCSET_DEFAULT_MAXSIZE);
+	fsstate->fetch_cxt = AllocSetContextCreate(estate->es_query_cxt,
+											   "postgres_fdw tuple data",
+											   ALLOCSET_DEFAULT_MINSIZE,
+											   ALLOCSET_DEFAULT_INITSIZE,
+											   ALLOCSET_DEFAULT_MAXSIZE);
 	fsstate->temp_cxt = AllocSetContextCreate(estate->es_query_cxt,
 											  "postgres_fdw temporary data",
 											  ALLOCSET_SMALL_MINSIZE,
 											  ALLOCSET_SMALL_INITSIZE,
 											  ALLOCSET_SMALL_MAXSIZE);
 
-	/* Get info we'll need for input data conversion. */
-	fsstate->attinmeta = TupleDescGetAttInMetadata(RelationGetDescr(fsstate->rel));
-
-	/* Prepare for output conversion of parameters used in remote query. */
-	numParams = list_length(fsplan->fdw_exprs);
-	fsstate->numParams = numParams;
-	fsstate->param_flinfo = (FmgrInfo *) palloc0(sizeof(FmgrInfo) * numParams);
-
-	i = 0;
-	foreach(lc, fsplan->fdw_exprs)
-	{
-		Node	   *param_expr = (Node *) lfirst(lc);
-		Oid			typefnoid;
-		bool		isvarlena;
-
-		getTypeOutputInfo(exprType(param_expr), &typefnoid, &isvarlena);
-		fmgr_info(typefnoid, &fsstate->param_flinfo[i]);
-		i++;
-	}
-
 	/*
-	 * Prepare remote-parameter expressions for evaluation.  (Note: in
-	 * practice, we expect that all these expressions will be just Params, so
-	 * we could possibly do something more efficient than using the full
-	 * expression-eval machinery for this.  But probably there would be little
-	 * benefit, and it'd require postgres_fdw to know more than is desirable
-	 * about Param evaluation.)
+	 * Get info we'll need for input data conversion.  Without a relation,
+	 * the rows are built to match the scan tuple slot, whose descriptor
+	 * comes from fdw_scan_tlist.
 	 */
-	fsstate->param_exprs = (List *)
-		ExecInitExpr((Expr *) fsplan->fdw_exprs,
-					 (PlanState *) node);
+	if (fsstate->rel)
+		fsstate->attinmeta = TupleDescGetAttInMetadata(RelationGetDescr(fsstate->rel));
+	else
+		fsstate->attinmeta =
+			TupleDescGetAttInMetadata(node->ss.ss_ScanTupleSlot->tts_tupleDescriptor);
 
 	/*
-	 * Allocate buffer for text form of query parameters, if any.
+	 * Prepare for processing of parameters used in remote query, if any.
 	 */
+	numParams = list_length(fsplan->fdw_exprs);
+	fsstate->numParams = numParams;
 	if (numParams > 0)
-		fsstate->param_values = (const char **) palloc0(numParams * sizeof(char *));
-	else
-		fsstate->param_values = NULL;
+		prepare_query_params((PlanState *) node,
+							 fsplan->fdw_exprs,
+							 numParams,
+							 &fsstate->param_flinfo,
+							 &fsstate->param_exprs,
+							 &fsstate->param_values);
 }
 
 /*
@@ -1042,11 +1443,19 @@ postgresReScanForeignScan(ForeignScanState *node)
 	PgFdwScanState *fsstate = (PgFdwScanState *) node->fdw_state;
 	char		sql[64];
 	PGresult   *res;
+	bool		fetched_ahead;
 
 	/* If we haven't created the cursor yet, nothing to do. */
 	if (!fsstate->cursor_exists)
 		return;
 
+	/*
+	 * Throw away a batch fetched ahead of time.  The cursor has moved past
+	 * it, so we must rewind.
+	 */
+	fetched_ahead = fsstate->fetch_in_progress || fsstate->fetch_received;
+	abandon_fetch(fsstate);
+
 	/*
 	 * If any internal parameters affecting this node have changed, we'd
 	 * better destroy and recreate the cursor.  Otherwise, rewinding it should
@@ -1059,7 +1468,7 @@ postgresReScanForeignScan(ForeignScanState *node)
 		snprintf(sql, sizeof(sql), "CLOSE c%u",
 				 fsstate->cursor_number);
 	}
-	else if (fsstate->fetch_ct_2 > 1)
+	else if (fsstate->fetch_ct_2 > 1 || fetched_ahead)
 	{
 		snprintf(sql, sizeof(sql), "MOVE BACKWARD ALL IN c%u",
 				 fsstate->cursor_number);
@@ -1075,6 +1484,7 @@ postgresReScanForeignScan(ForeignScanState *node)
 	 * We don't use a PG_TRY block here, so be careful not to throw error
 	 * without releasing the PGresult.
 	 */
+	CompletePendingRequest(fsstate->conn);
 	res = PQexec(fsstate->conn, sql);
 	if (PQresultStatus(res) != PGRES_COMMAND_OK)
 		pgfdw_report_error(ERROR, res, fsstate->conn, true, sql);
@@ -1101,6 +1511,9 @@ postgresEndForeignScan(ForeignScanState *node)
 	if (fsstate == NULL)
 		return;
 
+	/* Don't wait for the result of a FETCH sent ahead of time */
+	abandon_fetch(fsstate);
+
 	/* Close the cursor if open, to prevent accumulation of cursors */
 	if (fsstate->cursor_exists)
 		close_cursor(fsstate->conn, fsstate->cursor_number);
@@ -1112,6 +1525,55 @@ postgresEndForeignScan(ForeignScanState *node)
 	/* MemoryContexts will be deleted automatically. */
 }
 
+/*
+ * postgresIsForeignScanAsyncCapable
+ *		Tell whether the scan is to be run asynchronously under Append
+ */
+static bool
+postgresIsForeignScanAsyncCapable(ForeignScanState *node)
+{
+	PgFdwScanState *fsstate = (PgFdwScanState *) node->fdw_state;
+
+	return fsstate != NULL && fsstate->async_capable;
+}
+
+/*
+ * postgresForeignAsyncReady
+ *		Tell whether the scan can return a row without waiting for the
+ *		remote server
+ *
+ * If not, a FETCH has been sent, and *waitsock is set to the connection's
+ * socket, which becomes readable when its result arrives.
+ */
+static bool
+postgresForeignAsyncReady(ForeignScanState *node, pgsocket *waitsock)
+{
+	PgFdwScanState *fsstate = (PgFdwScanState *) node->fdw_state;
+	PGconn	   *conn = fsstate->conn;
+
+	if (!fsstate->cursor_exists)
+		create_cursor(node);
+
+	/* Ready if we have rows left, or know that there are no more */
+	if (fsstate->next_tuple < fsstate->num_tuples ||
+		fsstate->eof_reached || fsstate->fetch_received)
+		return true;
+
+	if (!fsstate->fetch_in_progress)
+		send_fetch_request(node);
+
+	if (!PQconsumeInput(conn))
+		pgfdw_report_error(ERROR, NULL, conn, false, fsstate->query);
+	if (PQisBusy(conn))
+	{
+		*waitsock = PQsocket(conn);
+		return false;
+	}
+
+	/* The result is here; postgresIterateForeignScan will pick it up */
+	return true;
+}
+
 /*
  * postgresAddForeignUpdateTargets
  *		Add resjunk column(s) needed for update/delete on a foreign table
@@ -1314,7 +1776,7 @@ postgresBeginForeignModify(ModifyTableState *mtstate,
 	 * Identify which user to do the remote access as.  This should match what
 	 * ExecCheckRTEPerms() does.
 	 */
-	rte = rt_fetch(resultRelInfo->ri_RangeTableIndex, estate->es_range_table);
+	rte = exec_rt_fetch(resultRelInfo->ri_RangeTableIndex, estate);
 	userid = rte->checkAsUser ? rte->checkAsUser : GetUserId();
 
 	/* Get info about foreign table. */
@@ -1417,6 +1879,7 @@ postgresExecForeignInsert(EState *estate,
 	 * We don't use a PG_TRY block here, so be careful not to throw error
 	 * without releasing the PGresult.
 	 */
+	CompletePendingRequest(fmstate->conn);
 	res = PQexecPrepared(fmstate->conn,
 						 fmstate->p_name,
 						 fmstate->p_nums,
@@ -1487,6 +1950,7 @@ postgresExecForeignUpdate(EState *estate,
 	 * We don't use a PG_TRY block here, so be careful not to throw error
 	 * without releasing the PGresult.
 	 */
+	CompletePendingRequest(fmstate->conn);
 	res = PQexecPrepared(fmstate->conn,
 						 fmstate->p_name,
 						 fmstate->p_nums,
@@ -1557,6 +2021,7 @@ postgresExecForeignDelete(EState *estate,
 	 * We don't use a PG_TRY block here, so be careful not to throw error
 	 * without releasing the PGresult.
 	 */
+	CompletePendingRequest(fmstate->conn);
 	res = PQexecPrepared(fmstate->conn,
 						 fmstate->p_name,
 						 fmstate->p_nums,
@@ -1613,6 +2078,7 @@ postgresEndForeignModify(EState *estate,
 		 * We don't use a PG_TRY block here, so be careful not to throw error
 		 * without releasing the PGresult.
 		 */
+		CompletePendingRequest(fmstate->conn);
 		res = PQexec(fmstate->conn, sql);
 		if (PQresultStatus(res) != PGRES_COMMAND_OK)
 			pgfdw_report_error(ERROR, res, fmstate->conn, true, sql);
@@ -1620,9 +2086,261 @@ postgresEndForeignModify(EState *estate,
 		fmstate->p_name = NULL;
 	}
 
-	/* Release remote connection */
-	ReleaseConnection(fmstate->conn);
-	fmstate->conn = NULL;
+	/* Likewise for a multi-row statement used by batched inserts */
+	if (fmstate->batch_p_name)
+	{
+		char		sql[64];
+		PGresult   *res;
+
+		snprintf(sql, sizeof(sql), "DEALLOCATE %s", fmstate->batch_p_name);
+
+		CompletePendingRequest(fmstate->conn);
+		res = PQexec(fmstate->conn, sql);
+		if (PQresultStatus(res) != PGRES_COMMAND_OK)
+			pgfdw_report_error(ERROR, res, fmstate->conn, true, sql);
+		PQclear(res);
+		fmstate->batch_p_name = NULL;
+	}
+
+	/* Release remote connection */
+	ReleaseConnection(fmstate->conn);
+	fmstate->conn = NULL;
+}
+
+/*
+ * postgresBeginForeignInsert
+ *		Begin a COPY FROM into a foreign table
+ *
+ * There's no plan, so we build the INSERT statement here, for all columns.
+ */
+static void
+postgresBeginForeignInsert(EState *estate,
+						   ResultRelInfo *resultRelInfo)
+{
+	PgFdwModifyState *fmstate;
+	Relation	rel = resultRelInfo->ri_RelationDesc;
+	TupleDesc	tupdesc = RelationGetDescr(rel);
+	RangeTblEntry *rte;
+	Oid			userid;
+	ForeignTable *table;
+	ForeignServer *server;
+	UserMapping *user;
+	StringInfoData sql;
+	Oid			typefnoid;
+	bool		isvarlena;
+	int			attnum;
+
+	fmstate = (PgFdwModifyState *) palloc0(sizeof(PgFdwModifyState));
+	fmstate->rel = rel;
+
+	/* Identify which user to do the remote access as, as for a modify */
+	rte = exec_rt_fetch(resultRelInfo->ri_RangeTableIndex, estate);
+	userid = rte->checkAsUser ? rte->checkAsUser : GetUserId();
+
+	table = GetForeignTable(RelationGetRelid(rel));
+	server = GetForeignServer(table->serverid);
+	user = GetUserMapping(userid, server->serverid);
+
+	fmstate->conn = GetConnection(server, user, true);
+	fmstate->p_name = NULL;
+	fmstate->batch_p_name = NULL;
+	fmstate->batch_nrows = 0;
+
+	for (attnum = 1; attnum <= tupdesc->natts; attnum++)
+	{
+		if (!tupdesc->attrs[attnum - 1]->attisdropped)
+			fmstate->target_attrs = lappend_int(fmstate->target_attrs, attnum);
+	}
+
+	/* The single-row statement, for postgresExecForeignInsert */
+	initStringInfo(&sql);
+	deparseBatchInsertSql(&sql, rel, fmstate->target_attrs, 1,
+					   rel->trigdesc && rel->trigdesc->trig_insert_after_row,
+						  &fmstate->retrieved_attrs);
+	fmstate->query = sql.data;
+	fmstate->has_returning = (fmstate->retrieved_attrs != NIL);
+
+	fmstate->temp_cxt = AllocSetContextCreate(estate->es_query_cxt,
+											  "postgres_fdw temporary data",
+											  ALLOCSET_SMALL_MINSIZE,
+											  ALLOCSET_SMALL_INITSIZE,
+											  ALLOCSET_SMALL_MAXSIZE);
+
+	if (fmstate->has_returning)
+		fmstate->attinmeta = TupleDescGetAttInMetadata(tupdesc);
+
+	fmstate->p_flinfo = (FmgrInfo *)
+		palloc0(sizeof(FmgrInfo) * (list_length(fmstate->target_attrs) + 1));
+	fmstate->p_nums = 0;
+	for (attnum = 1; attnum <= tupdesc->natts; attnum++)
+	{
+		Form_pg_attribute attr = tupdesc->attrs[attnum - 1];
+
+		if (attr->attisdropped)
+			continue;
+		getTypeOutputInfo(attr->atttypid, &typefnoid, &isvarlena);
+		fmgr_info(typefnoid, &fmstate->p_flinfo[fmstate->p_nums]);
+		fmstate->p_nums++;
+	}
+
+	resultRelInfo->ri_FdwState = fmstate;
+}
+
+/*
+ * postgresExecForeignBatchInsert
+ *		Insert several rows into a foreign table, for COPY FROM or a batched
+ *		INSERT
+ *
+ * The rows are sent in multi-row INSERT statements, as many rows at a time
+ * as the protocol's limit on the number of parameters allows.  The statement
+ * for a full batch is prepared the first time it's needed and reused; a
+ * short batch at the end is sent unprepared.
+ */
+static int
+postgresExecForeignBatchInsert(EState *estate,
+							   ResultRelInfo *resultRelInfo,
+							   TupleTableSlot **slots,
+							   int nslots)
+{
+	PgFdwModifyState *fmstate = (PgFdwModifyState *) resultRelInfo->ri_FdwState;
+	int			maxrows;
+	int			ninserted = 0;
+	int			start;
+
+	/* Without any columns, there's no multi-row form */
+	if (fmstate->p_nums == 0)
+	{
+		for (start = 0; start < nslots; start++)
+		{
+			if (postgresExecForeignInsert(estate, resultRelInfo,
+										  slots[start], NULL) != NULL)
+				ninserted++;
+		}
+		return ninserted;
+	}
+
+	maxrows = Min(nslots, MAX_BATCH_INSERT_PARAMS / fmstate->p_nums);
+
+	for (start = 0; start < nslots; start += maxrows)
+	{
+		int			nrows = Min(maxrows, nslots - start);
+		const char **p_values;
+		List	   *retrieved_attrs;
+		PGresult   *res;
+		int			i;
+
+		p_values = (const char **)
+			MemoryContextAlloc(fmstate->temp_cxt,
+							   sizeof(char *) * nrows * fmstate->p_nums);
+		for (i = 0; i < nrows; i++)
+			memcpy(p_values + i * fmstate->p_nums,
+				   convert_prep_stmt_params(fmstate, NULL, slots[start + i]),
+				   sizeof(char *) * fmstate->p_nums);
+
+		/* Prepare the statement for a full batch, if we didn't yet */
+		if (nrows == maxrows && fmstate->batch_p_name == NULL)
+		{
+			char		prep_name[NAMEDATALEN];
+			StringInfoData sql;
+
+			initStringInfo(&sql);
+			deparseBatchInsertSql(&sql, fmstate->rel, fmstate->target_attrs,
+								  nrows, false, &retrieved_attrs);
+
+			snprintf(prep_name, sizeof(prep_name), "pgsql_fdw_prep_%u",
+					 GetPrepStmtNumber(fmstate->conn));
+
+			/*
+			 * We don't use a PG_TRY block here, so be careful not to throw
+			 * error without releasing the PGresult.
+			 */
+			CompletePendingRequest(fmstate->conn);
+			res = PQprepare(fmstate->conn, prep_name, sql.data, 0, NULL);
+			if (PQresultStatus(res) != PGRES_COMMAND_OK)
+				pgfdw_report_error(ERROR, res, fmstate->conn, true, sql.data);
+			PQclear(res);
+
+			fmstate->batch_p_name = pstrdup(prep_name);
+			fmstate->batch_nrows = nrows;
+			pfree(sql.data);
+		}
+
+		CompletePendingRequest(fmstate->conn);
+		if (nrows == fmstate->batch_nrows)
+			res = PQexecPrepared(fmstate->conn,
+								 fmstate->batch_p_name,
+								 nrows * fmstate->p_nums,
+								 p_values,
+								 NULL,
+								 NULL,
+								 0);
+		else
+		{
+			StringInfoData sql;
+
+			initStringInfo(&sql);
+			deparseBatchInsertSql(&sql, fmstate->rel, fmstate->target_attrs,
+								  nrows, false, &retrieved_attrs);
+			res = PQexecParams(fmstate->conn,
+							   sql.data,
+							   nrows * fmstate->p_nums,
+							   NULL,
+							   p_values,
+							   NULL,
+							   NULL,
+							   0);
+			pfree(sql.data);
+		}
+		if (PQresultStatus(res) != PGRES_COMMAND_OK)
+			pgfdw_report_error(ERROR, res, fmstate->conn, true,
+							   fmstate->query);
+
+		ninserted += atoi(PQcmdTuples(res));
+
+		PQclear(res);
+
+		MemoryContextReset(fmstate->temp_cxt);
+	}
+
+	return ninserted;
+}
+
+/*
+ * postgresEndForeignInsert
+ *		Finish a COPY FROM into a foreign table
+ */
+static void
+postgresEndForeignInsert(EState *estate,
+						 ResultRelInfo *resultRelInfo)
+{
+	/* Same as for a modify */
+	postgresEndForeignModify(estate, resultRelInfo);
+}
+
+/*
+ * postgresGetForeignModifyBatchSize
+ *		Determine how many rows an INSERT should send to the foreign table
+ *		at a time
+ *
+ * The executor only asks when it can batch the rows, that is, there is no
+ * RETURNING clause or AFTER ROW trigger that needs each row back at once.
+ */
+static int
+postgresGetForeignModifyBatchSize(ResultRelInfo *resultRelInfo)
+{
+	PgFdwModifyState *fmstate = (PgFdwModifyState *) resultRelInfo->ri_FdwState;
+	Relation	rel = resultRelInfo->ri_RelationDesc;
+	ForeignTable *table;
+	ForeignServer *server;
+
+	/* Rows that return something must be inserted one at a time */
+	if (fmstate && fmstate->has_returning)
+		return 1;
+
+	table = GetForeignTable(RelationGetRelid(rel));
+	server = GetForeignServer(table->serverid);
+
+	return get_batch_size(server, table);
 }
 
 /*
@@ -1671,89 +2389,393 @@ postgresIsForeignRelUpdatable(Relation rel)
 }
 
 /*
- * postgresExplainForeignScan
- *		Produce extra output for EXPLAIN of a ForeignScan on a foreign table
+ * postgresPlanDirectModify
+ *		Consider doing an UPDATE or DELETE directly on the remote server
+ *
+ * That is possible when the subplan is a scan of the target foreign table
+ * alone, whose conditions are all checked remotely, the new column values
+ * can be computed remotely, and nothing needs to see the modified rows:
+ * there's no RETURNING clause, WITH CHECK OPTION or row-level trigger.  If
+ * so, we turn the subplan into a ForeignScan that runs a single UPDATE or
+ * DELETE statement, and ModifyTable does nothing more for this table.
  */
-static void
-postgresExplainForeignScan(ForeignScanState *node, ExplainState *es)
+static bool
+postgresPlanDirectModify(PlannerInfo *root,
+						 ModifyTable *plan,
+						 Index resultRelation,
+						 int subplan_index)
 {
-	List	   *fdw_private;
-	char	   *sql;
+	CmdType		operation = plan->operation;
+	Plan	   *subplan = (Plan *) list_nth(plan->plans, subplan_index);
+	RangeTblEntry *rte = planner_rt_fetch(resultRelation, root);
+	ForeignScan *fscan;
+	Relation	rel;
+	TriggerDesc *trigdesc;
+	RelOptInfo *foreignrel;
+	List	   *targetAttrs = NIL;
+	List	   *remote_conds;
+	List	   *params_list = NIL;
+	StringInfoData sql;
 
-	if (es->verbose)
+	if (operation != CMD_UPDATE && operation != CMD_DELETE)
+		return false;
+
+	/* The subplan must scan the target table, with no local conditions */
+	if (!IsA(subplan, ForeignScan))
+		return false;
+	fscan = (ForeignScan *) subplan;
+	if (fscan->scan.scanrelid != resultRelation || subplan->qual != NIL)
+		return false;
+
+	/* Nothing may need to see the modified rows */
+	if (plan->returningLists != NIL &&
+		list_nth(plan->returningLists, subplan_index) != NIL)
+		return false;
+	if (plan->withCheckOptionLists != NIL &&
+		list_nth(plan->withCheckOptionLists, subplan_index) != NIL)
+		return false;
+
+	/*
+	 * Core code already has some lock on each rel being planned, so we can
+	 * use NoLock here.
+	 */
+	rel = heap_open(rte->relid, NoLock);
+
+	trigdesc = rel->trigdesc;
+	if (trigdesc &&
+		(operation == CMD_UPDATE ?
+		 (trigdesc->trig_update_before_row ||
+		  trigdesc->trig_update_after_row) :
+		 (trigdesc->trig_delete_before_row ||
+		  trigdesc->trig_delete_after_row)))
 	{
-		fdw_private = ((ForeignScan *) node->ss.ps.plan)->fdw_private;
-		sql = strVal(list_nth(fdw_private, FdwScanPrivateSelectSql));
-		ExplainPropertyText("Remote SQL", sql, es);
+		heap_close(rel, NoLock);
+		return false;
 	}
-}
 
-/*
- * postgresExplainForeignModify
- *		Produce extra output for EXPLAIN of a ModifyTable on a foreign table
- */
-static void
-postgresExplainForeignModify(ModifyTableState *mtstate,
-							 ResultRelInfo *rinfo,
-							 List *fdw_private,
-							 int subplan_index,
-							 ExplainState *es)
-{
-	if (es->verbose)
+	/*
+	 * In an inherited UPDATE/DELETE the target's RelOptInfo lives in a
+	 * planner root of its own, so make a minimal one: deparsing only needs
+	 * to know which Vars belong to the foreign table.
+	 */
+	foreignrel = makeNode(RelOptInfo);
+	foreignrel->reloptkind = RELOPT_BASEREL;
+	foreignrel->relid = resultRelation;
+	foreignrel->relids = bms_make_singleton(resultRelation);
+
+	/*
+	 * For an UPDATE, the subplan computes the new value of each target
+	 * column; all those expressions must be safe to evaluate remotely.
+	 */
+	if (operation == CMD_UPDATE)
 	{
-		char	   *sql = strVal(list_nth(fdw_private,
-										  FdwModifyPrivateUpdateSql));
+		int			col;
 
-		ExplainPropertyText("Remote SQL", sql, es);
+		col = -1;
+		while ((col = bms_next_member(rte->updatedCols, col)) >= 0)
+		{
+			/* bit numbers are offset by FirstLowInvalidHeapAttributeNumber */
+			AttrNumber	attno = col + FirstLowInvalidHeapAttributeNumber;
+			TargetEntry *tle;
+
+			if (attno <= InvalidAttrNumber)		/* shouldn't happen */
+				elog(ERROR, "system-column update is not supported");
+
+			tle = get_tle_by_resno(subplan->targetlist, attno);
+			if (!tle)
+				elog(ERROR, "attribute number %d not found in subplan targetlist",
+					 attno);
+
+			if (!is_foreign_expr(root, foreignrel, tle->expr))
+			{
+				heap_close(rel, NoLock);
+				return false;
+			}
+
+			targetAttrs = lappend_int(targetAttrs, attno);
+		}
 	}
-}
 
+	/*
+	 * OK, build the statement, from the conditions the scan would have sent
+	 * to the remote server.
+	 */
+	remote_conds = (List *) list_nth(fscan->fdw_private,
+									 FdwScanPrivateRemoteConds);
+
+	initStringInfo(&sql);
+	if (operation == CMD_UPDATE)
+		deparseDirectUpdateSql(&sql, root, resultRelation, rel, foreignrel,
+							   subplan->targetlist, targetAttrs,
+							   remote_conds, &params_list);
+	else
+		deparseDirectDeleteSql(&sql, root, resultRelation, rel, foreignrel,
+							   remote_conds, &params_list);
+
+	heap_close(rel, NoLock);
+
+	/*
+	 * Rewrite the subplan.  The remote parameter expressions replace those
+	 * of the scan, and the fdw_private list must match enum
+	 * FdwDirectModifyPrivateIndex, above.
+	 */
+	fscan->operation = operation;
+	fscan->fdw_exprs = params_list;
+	fscan->fdw_private = list_make2(makeString(sql.data),
+									makeInteger(plan->canSetTag));
+
+	return true;
+}
 
 /*
- * estimate_path_cost_size
- *		Get cost and size estimates for a foreign scan
- *
- * We assume that all the baserestrictinfo clauses will be applied, plus
- * any join clauses listed in join_conds.
+ * postgresBeginDirectModify
+ *		Prepare a direct foreign table modification
  */
 static void
-estimate_path_cost_size(PlannerInfo *root,
-						RelOptInfo *baserel,
-						List *join_conds,
-						double *p_rows, int *p_width,
-						Cost *p_startup_cost, Cost *p_total_cost)
+postgresBeginDirectModify(ForeignScanState *node, int eflags)
 {
-	PgFdwRelationInfo *fpinfo = (PgFdwRelationInfo *) baserel->fdw_private;
-	double		rows;
-	double		retrieved_rows;
-	int			width;
-	Cost		startup_cost;
-	Cost		total_cost;
-	Cost		run_cost;
-	Cost		cpu_per_tuple;
+	ForeignScan *fsplan = (ForeignScan *) node->ss.ps.plan;
+	EState	   *estate = node->ss.ps.state;
+	PgFdwDirectModifyState *dmstate;
+	RangeTblEntry *rte;
+	Oid			userid;
+	ForeignTable *table;
+	ForeignServer *server;
+	UserMapping *user;
+	int			numParams;
 
 	/*
-	 * If the table or the server is configured to use remote estimates,
-	 * connect to the foreign server and execute EXPLAIN to estimate the
-	 * number of rows selected by the restriction+join clauses.  Otherwise,
-	 * estimate rows using whatever statistics we have locally, in a way
-	 * similar to ordinary tables.
+	 * Do nothing in EXPLAIN (no ANALYZE) case.  node->fdw_state stays NULL.
 	 */
-	if (fpinfo->use_remote_estimate)
-	{
-		List	   *remote_join_conds;
-		List	   *local_join_conds;
-		StringInfoData sql;
-		List	   *retrieved_attrs;
-		PGconn	   *conn;
-		Selectivity local_sel;
-		QualCost	local_cost;
+	if (eflags & EXEC_FLAG_EXPLAIN_ONLY)
+		return;
+
+	/*
+	 * We'll save private state in node->fdw_state.
+	 */
+	dmstate = (PgFdwDirectModifyState *) palloc0(sizeof(PgFdwDirectModifyState));
+	node->fdw_state = (void *) dmstate;
+
+	/*
+	 * Identify which user to do the remote access as.  This should match what
+	 * ExecCheckRTEPerms() does.
+	 */
+	rte = exec_rt_fetch(fsplan->scan.scanrelid, estate);
+	userid = rte->checkAsUser ? rte->checkAsUser : GetUserId();
+
+	/* Get info about foreign table. */
+	dmstate->rel = node->ss.ss_currentRelation;
+	table = GetForeignTable(RelationGetRelid(dmstate->rel));
+	server = GetForeignServer(table->serverid);
+	user = GetUserMapping(userid, server->serverid);
+
+	/*
+	 * Get connection to the foreign server.  Connection manager will
+	 * establish new connection if necessary.
+	 */
+	dmstate->conn = GetConnection(server, user, false);
+
+	/* Get private info created by planner functions. */
+	dmstate->query = strVal(list_nth(fsplan->fdw_private,
+									 FdwDirectModifyPrivateUpdateSql));
+	dmstate->set_processed = intVal(list_nth(fsplan->fdw_private,
+										 FdwDirectModifyPrivateSetProcessed));
+
+	/*
+	 * Prepare for processing of parameters used in remote query, if any.
+	 */
+	numParams = list_length(fsplan->fdw_exprs);
+	dmstate->numParams = numParams;
+	if (numParams > 0)
+		prepare_query_params((PlanState *) node,
+							 fsplan->fdw_exprs,
+							 numParams,
+							 &dmstate->param_flinfo,
+							 &dmstate->param_exprs,
+							 &dmstate->param_values);
+}
+
+/*
+ * postgresIterateDirectModify
+ *		Run the UPDATE or DELETE on the remote server the first time through,
+ *		and report that there are no rows to process
+ */
+static TupleTableSlot *
+postgresIterateDirectModify(ForeignScanState *node)
+{
+	PgFdwDirectModifyState *dmstate = (PgFdwDirectModifyState *) node->fdw_state;
+	EState	   *estate = node->ss.ps.state;
+	TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
+	ExprContext *econtext = node->ss.ps.ps_ExprContext;
+	PGresult   *res;
+
+	if (!dmstate->done)
+	{
+		/* Construct the values of the query parameters, if any */
+		if (dmstate->numParams > 0)
+			process_query_params(econtext,
+								 dmstate->param_flinfo,
+								 dmstate->param_exprs,
+								 dmstate->param_values);
+
+		/*
+		 * Notice that we pass NULL for paramTypes, thus forcing the remote
+		 * server to infer types for all parameters, as in create_cursor.
+		 *
+		 * We don't use a PG_TRY block here, so be careful not to throw error
+		 * without releasing the PGresult.
+		 */
+		CompletePendingRequest(dmstate->conn);
+		res = PQexecParams(dmstate->conn, dmstate->query,
+						   dmstate->numParams, NULL, dmstate->param_values,
+						   NULL, NULL, 0);
+		if (PQresultStatus(res) != PGRES_COMMAND_OK)
+			pgfdw_report_error(ERROR, res, dmstate->conn, true,
+							   dmstate->query);
+
+		/* Count the rows modified, as ModifyTable would have */
+		if (dmstate->set_processed)
+			estate->es_processed += atoi(PQcmdTuples(res));
+
+		PQclear(res);
+
+		dmstate->done = true;
+	}
+
+	return ExecClearTuple(slot);
+}
+
+/*
+ * postgresEndDirectModify
+ *		Finish a direct foreign table modification
+ */
+static void
+postgresEndDirectModify(ForeignScanState *node)
+{
+	PgFdwDirectModifyState *dmstate = (PgFdwDirectModifyState *) node->fdw_state;
+
+	/* if dmstate is NULL, we are in EXPLAIN; nothing to do */
+	if (dmstate == NULL)
+		return;
+
+	/* Release remote connection */
+	ReleaseConnection(dmstate->conn);
+	dmstate->conn = NULL;
+}
+
+/*
+ * postgresExplainForeignScan
+ *		Produce extra output for EXPLAIN of a ForeignScan on a foreign table
+ */
+static void
+postgresExplainForeignScan(ForeignScanState *node, ExplainState *es)
+{
+	List	   *fdw_private;
+	char	   *sql;
+
+	if (es->verbose)
+	{
+		fdw_private = ((ForeignScan *) node->ss.ps.plan)->fdw_private;
+		sql = strVal(list_nth(fdw_private, FdwScanPrivateSelectSql));
+		ExplainPropertyText("Remote SQL", sql, es);
+	}
+}
+
+/*
+ * postgresExplainForeignModify
+ *		Produce extra output for EXPLAIN of a ModifyTable on a foreign table
+ */
+static void
+postgresExplainForeignModify(ModifyTableState *mtstate,
+							 ResultRelInfo *rinfo,
+							 List *fdw_private,
+							 int subplan_index,
+							 ExplainState *es)
+{
+	if (es->verbose)
+	{
+		char	   *sql = strVal(list_nth(fdw_private,
+										  FdwModifyPrivateUpdateSql));
+
+		ExplainPropertyText("Remote SQL", sql, es);
+
+		/* Show the number of rows sent at a time, if they're batched */
+		if (rinfo->ri_BatchSize > 1)
+			ExplainPropertyInteger("Batch Size", rinfo->ri_BatchSize, es);
+	}
+}
+
+/*
+ * postgresExplainDirectModify
+ *		Produce extra output for EXPLAIN of a ForeignScan that modifies a
+ *		foreign table directly
+ */
+static void
+postgresExplainDirectModify(ForeignScanState *node, ExplainState *es)
+{
+	List	   *fdw_private;
+	char	   *sql;
+
+	if (es->verbose)
+	{
+		fdw_private = ((ForeignScan *) node->ss.ps.plan)->fdw_private;
+		sql = strVal(list_nth(fdw_private, FdwDirectModifyPrivateUpdateSql));
+		ExplainPropertyText("Remote SQL", sql, es);
+	}
+}
+
+
+/*
+ * estimate_path_cost_size
+ *		Get cost and size estimates for a foreign scan of a foreign table or
+ *		a join of foreign tables
+ *
+ * We assume that all the baserestrictinfo clauses will be applied, plus
+ * any join clauses listed in join_conds.  If pathkeys isn't NIL the remote
+ * query sorts its rows accordingly, and if limit_tuples is positive it
+ * returns at most that many.
+ */
+static void
+estimate_path_cost_size(PlannerInfo *root,
+						RelOptInfo *foreignrel,
+						List *join_conds,
+						List *pathkeys,
+						double limit_tuples,
+						double *p_rows, int *p_width,
+						Cost *p_startup_cost, Cost *p_total_cost)
+{
+	PgFdwRelationInfo *fpinfo = (PgFdwRelationInfo *) foreignrel->fdw_private;
+	double		rows;
+	double		retrieved_rows;
+	int			width;
+	Cost		startup_cost;
+	Cost		total_cost;
+	Cost		run_cost;
+	Cost		cpu_per_tuple;
+
+	/*
+	 * If the table or the server is configured to use remote estimates,
+	 * connect to the foreign server and execute EXPLAIN to estimate the
+	 * number of rows selected by the restriction+join clauses.  Otherwise,
+	 * estimate rows using whatever statistics we have locally, in a way
+	 * similar to ordinary tables.
+	 */
+	if (fpinfo->use_remote_estimate)
+	{
+		List	   *remote_join_conds;
+		List	   *local_join_conds;
+		List	   *remote_conds;
+		StringInfoData sql;
+		List	   *retrieved_attrs;
+		PGconn	   *conn;
+		Selectivity local_sel;
+		QualCost	local_cost;
 
 		/*
 		 * join_conds might contain both clauses that are safe to send across,
 		 * and clauses that aren't.
 		 */
-		classifyConditions(root, baserel, join_conds,
+		classifyConditions(root, foreignrel, join_conds,
 						   &remote_join_conds, &local_join_conds);
 
 		/*
@@ -1761,16 +2783,14 @@ estimate_path_cost_size(PlannerInfo *root,
 		 * WHERE clauses.  Params and other-relation Vars are replaced by
 		 * dummy values.
 		 */
+		remote_conds = list_concat(list_copy(fpinfo->remote_conds),
+								   remote_join_conds);
 		initStringInfo(&sql);
 		appendStringInfoString(&sql, "EXPLAIN ");
-		deparseSelectSql(&sql, root, baserel, fpinfo->attrs_used,
-						 &retrieved_attrs);
-		if (fpinfo->remote_conds)
-			appendWhereClause(&sql, root, baserel, fpinfo->remote_conds,
-							  true, NULL);
-		if (remote_join_conds)
-			appendWhereClause(&sql, root, baserel, remote_join_conds,
-							  (fpinfo->remote_conds == NIL), NULL);
+		deparseSelectStmtForRel(&sql, root, foreignrel,
+								build_tlist_to_deparse(foreignrel),
+								remote_conds, pathkeys, limit_tuples,
+								&retrieved_attrs, NULL);
 
 		/* Get the remote estimate */
 		conn = GetConnection(fpinfo->server, fpinfo->user, false);
@@ -1778,158 +2798,636 @@ estimate_path_cost_size(PlannerInfo *root,
 							&startup_cost, &total_cost);
 		ReleaseConnection(conn);
 
-		retrieved_rows = rows;
+		retrieved_rows = rows;
+
+		/* Factor in the selectivity of the locally-checked quals */
+		local_sel = clauselist_selectivity(root,
+										   local_join_conds,
+										   foreignrel->relid,
+										   JOIN_INNER,
+										   NULL);
+		local_sel *= fpinfo->local_conds_sel;
+
+		rows = clamp_row_est(rows * local_sel);
+
+		/* Add in the eval cost of the locally-checked quals */
+		startup_cost += fpinfo->local_conds_cost.startup;
+		total_cost += fpinfo->local_conds_cost.per_tuple * retrieved_rows;
+		cost_qual_eval(&local_cost, local_join_conds, root);
+		startup_cost += local_cost.startup;
+		total_cost += local_cost.per_tuple * retrieved_rows;
+	}
+	else
+	{
+		/*
+		 * We don't support join conditions in this mode (hence, no
+		 * parameterized paths can be made).
+		 */
+		Assert(join_conds == NIL);
+
+		if (foreignrel->reloptkind == RELOPT_JOINREL)
+		{
+			PgFdwRelationInfo *fpinfo_o;
+			PgFdwRelationInfo *fpinfo_i;
+			QualCost	join_cost;
+			QualCost	remote_conds_cost;
+
+			fpinfo_o = (PgFdwRelationInfo *) fpinfo->outerrel->fdw_private;
+			fpinfo_i = (PgFdwRelationInfo *) fpinfo->innerrel->fdw_private;
+
+			/* Use rows/width estimates made by the core planner. */
+			rows = foreignrel->rows;
+			width = foreignrel->width;
+			retrieved_rows = rows;
+
+			/*
+			 * Cost the remote join as a hash join of the two inputs: the
+			 * inner one is read and hashed before the first row comes out,
+			 * each input row is hashed once, and the join and WHERE clauses
+			 * are evaluated for each output row.  We have no idea of the
+			 * join's actual selectivity, so that's about all we can do.
+			 */
+			cost_qual_eval(&join_cost, fpinfo->joinclauses, root);
+			cost_qual_eval(&remote_conds_cost, fpinfo->remote_conds, root);
+
+			startup_cost = fpinfo_i->rel_total_cost + fpinfo_o->rel_startup_cost;
+			startup_cost += join_cost.startup + remote_conds_cost.startup;
+
+			run_cost = fpinfo_o->rel_total_cost - fpinfo_o->rel_startup_cost;
+			run_cost += cpu_operator_cost * (fpinfo_i->rows + fpinfo_o->rows);
+			cpu_per_tuple = cpu_tuple_cost + join_cost.per_tuple +
+				remote_conds_cost.per_tuple;
+			run_cost += cpu_per_tuple * rows;
+
+			total_cost = startup_cost + run_cost;
+		}
+		else
+		{
+			/* Use rows/width estimates made by set_baserel_size_estimates. */
+			rows = foreignrel->rows;
+			width = foreignrel->width;
+
+			/*
+			 * Back into an estimate of the number of retrieved rows.  Just in
+			 * case this is nuts, clamp to at most foreignrel->tuples.
+			 */
+			retrieved_rows = clamp_row_est(rows / fpinfo->local_conds_sel);
+			retrieved_rows = Min(retrieved_rows, foreignrel->tuples);
+
+			/*
+			 * Cost as though this were a seqscan, which is pessimistic.  We
+			 * effectively imagine the local_conds are being evaluated
+			 * remotely, too.
+			 */
+			startup_cost = 0;
+			run_cost = 0;
+			run_cost += seq_page_cost * foreignrel->pages;
+
+			startup_cost += foreignrel->baserestrictcost.startup;
+			cpu_per_tuple = cpu_tuple_cost + foreignrel->baserestrictcost.per_tuple;
+			run_cost += cpu_per_tuple * foreignrel->tuples;
+
+			total_cost = startup_cost + run_cost;
+		}
+
+		/*
+		 * We have no idea what sorting costs the remote server, so charge a
+		 * fixed fraction extra.  The whole result must be sorted before the
+		 * first row comes out.
+		 */
+		if (pathkeys != NIL)
+		{
+			total_cost *= DEFAULT_FDW_SORT_MULTIPLIER;
+			startup_cost = total_cost;
+		}
+
+		/*
+		 * With a LIMIT, the remote server stops after that many rows (only
+		 * done when there are no local conditions to filter them).
+		 */
+		if (limit_tuples > 0 && limit_tuples < rows)
+		{
+			total_cost = startup_cost +
+				(total_cost - startup_cost) * limit_tuples / rows;
+			rows = retrieved_rows = limit_tuples;
+		}
+	}
+
+	/*
+	 * Remember the cost of scanning the relation itself, without pathkeys
+	 * or LIMIT and before adding the transfer overhead, for estimating the
+	 * cost of joins including it.
+	 */
+	if (join_conds == NIL && pathkeys == NIL && limit_tuples <= 0)
+	{
+		fpinfo->rel_startup_cost = startup_cost;
+		fpinfo->rel_total_cost = total_cost;
+	}
+
+	/*
+	 * Add some additional cost factors to account for connection overhead
+	 * (fdw_startup_cost), transferring data across the network
+	 * (fdw_tuple_cost per retrieved row), and local manipulation of the data
+	 * (cpu_tuple_cost per retrieved row).
+	 */
+	startup_cost += fpinfo->fdw_startup_cost;
+	total_cost += fpinfo->fdw_startup_cost;
+	total_cost += fpinfo->fdw_tuple_cost * retrieved_rows;
+	total_cost += cpu_tuple_cost * retrieved_rows;
+
+	/* Return results. */
+	*p_rows = rows;
+	*p_width = width;
+	*p_startup_cost = startup_cost;
+	*p_total_cost = total_cost;
+}
+
+/*
+ * Estimate costs of executing a SQL statement remotely.
+ * The given "sql" must be an EXPLAIN command.
+ */
+static void
+get_remote_estimate(const char *sql, PGconn *conn,
+					double *rows, int *width,
+					Cost *startup_cost, Cost *total_cost)
+{
+	PGresult   *volatile res = NULL;
+
+	/* PGresult must be released before leaving this function. */
+	PG_TRY();
+	{
+		char	   *line;
+		char	   *p;
+		int			n;
+
+		/*
+		 * Execute EXPLAIN remotely.
+		 */
+		CompletePendingRequest(conn);
+		res = PQexec(conn, sql);
+		if (PQresultStatus(res) != PGRES_TUPLES_OK)
+			pgfdw_report_error(ERROR, res, conn, false, sql);
+
+		/*
+		 * Extract cost numbers for topmost plan node.  Note we search for a
+		 * left paren from the end of the line to avoid being confused by
+		 * other uses of parentheses.
+		 */
+		line = PQgetvalue(res, 0, 0);
+		p = strrchr(line, '(');
+		if (p == NULL)
+			elog(ERROR, "could not interpret EXPLAIN output: \"%s\"", line);
+		n = sscanf(p, "(cost=%lf..%lf rows=%lf width=%d)",
+				   startup_cost, total_cost, rows, width);
+		if (n != 4)
+			elog(ERROR, "could not interpret EXPLAIN output: \"%s\"", line);
+
+		PQclear(res);
+		res = NULL;
+	}
+	PG_CATCH();
+	{
+		if (res)
+			PQclear(res);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+}
+
+/*
+ * Detect whether we want to process an EquivalenceClass member.
+ *
+ * This is a callback for use by generate_implied_equalities_for_column.
+ */
+static bool
+ec_member_matches_foreign(PlannerInfo *root, RelOptInfo *rel,
+						  EquivalenceClass *ec, EquivalenceMember *em,
+						  void *arg)
+{
+	ec_member_foreign_arg *state = (ec_member_foreign_arg *) arg;
+	Expr	   *expr = em->em_expr;
+
+	/*
+	 * If we've identified what we're processing in the current scan, we only
+	 * want to match that expression.
+	 */
+	if (state->current != NULL)
+		return equal(expr, state->current);
+
+	/*
+	 * Otherwise, ignore anything we've already processed.
+	 */
+	if (list_member(state->already_used, expr))
+		return false;
+
+	/* This is the new target to process. */
+	state->current = expr;
+	return true;
+}
+
+/*
+ * Get the fetch_size option of a foreign table, or failing that of its
+ * server.  table may be NULL, for a join.
+ */
+static int
+get_fetch_size(ForeignServer *server, ForeignTable *table)
+{
+	int			fetch_size = DEFAULT_FETCH_SIZE;
+	ListCell   *lc;
+
+	foreach(lc, server->options)
+	{
+		DefElem    *def = (DefElem *) lfirst(lc);
+
+		if (strcmp(def->defname, "fetch_size") == 0)
+			fetch_size = strtol(defGetString(def), NULL, 10);
+	}
+	if (table)
+	{
+		foreach(lc, table->options)
+		{
+			DefElem    *def = (DefElem *) lfirst(lc);
+
+			if (strcmp(def->defname, "fetch_size") == 0)
+				fetch_size = strtol(defGetString(def), NULL, 10);
+		}
+	}
+
+	return fetch_size;
+}
+
+/*
+ * Get the batch_size option of a foreign table, or failing that of its
+ * server.
+ */
+static int
+get_batch_size(ForeignServer *server, ForeignTable *table)
+{
+	int			batch_size = 1;
+	ListCell   *lc;
+
+	foreach(lc, server->options)
+	{
+		DefElem    *def = (DefElem *) lfirst(lc);
+
+		if (strcmp(def->defname, "batch_size") == 0)
+			batch_size = strtol(defGetString(def), NULL, 10);
+	}
+	foreach(lc, table->options)
+	{
+		DefElem    *def = (DefElem *) lfirst(lc);
+
+		if (strcmp(def->defname, "batch_size") == 0)
+			batch_size = strtol(defGetString(def), NULL, 10);
+	}
+
+	return batch_size;
+}
+
+/*
+ * Return root->query_pathkeys if the remote query for rel can produce its
+ * rows in that order, else NIL.
+ *
+ * Each pathkey needs an expression computable from rel that is safe to send,
+ * and must use the default sort order of that expression's type, since
+ * that's what ORDER BY ... ASC/DESC means remotely.
+ */
+static List *
+get_useful_pathkeys_for_relation(PlannerInfo *root, RelOptInfo *rel)
+{
+	ListCell   *lc;
+
+	if (root->query_pathkeys == NIL)
+		return NIL;
+
+	foreach(lc, root->query_pathkeys)
+	{
+		PathKey    *pathkey = (PathKey *) lfirst(lc);
+		EquivalenceClass *ec = pathkey->pk_eclass;
+		Expr	   *em_expr;
+		Oid			opclass;
+
+		if (ec->ec_has_volatile)
+			return NIL;
+
+		em_expr = find_em_expr_for_rel(ec, rel);
+		if (em_expr == NULL || !is_foreign_expr(root, rel, em_expr))
+			return NIL;
+
+		opclass = GetDefaultOpClass(exprType((Node *) em_expr), BTREE_AM_OID);
+		if (!OidIsValid(opclass) ||
+			get_opclass_family(opclass) != pathkey->pk_opfamily)
+			return NIL;
+	}
+
+	return root->query_pathkeys;
+}
+
+/*
+ * Can the remote query for rel apply the query's LIMIT?
+ *
+ * Only if rel makes up the whole FROM list, all its conditions are checked
+ * remotely, and nothing between the scan and the Limit node can remove rows
+ * or add more.  (limit_tuples isn't set if there's grouping, aggregation,
+ * DISTINCT or window functions.)
+ */
+static bool
+limit_pushdown_ok(PlannerInfo *root, RelOptInfo *rel)
+{
+	PgFdwRelationInfo *fpinfo = (PgFdwRelationInfo *) rel->fdw_private;
+	Query	   *parse = root->parse;
+
+	if (root->limit_tuples <= 0)
+		return false;
+	if (parse->commandType != CMD_SELECT || root->rowMarks != NIL)
+		return false;
+	if (!bms_equal(rel->relids, root->all_baserels))
+		return false;
+	if (fpinfo->local_conds != NIL)
+		return false;
+	if (expression_returns_set((Node *) parse->targetList))
+		return false;
+
+	return true;
+}
+
+/*
+ * Add a path for rel whose remote query sorts the rows the way the query
+ * wants them, and applies the query's LIMIT if possible; or, for a query
+ * without ORDER BY, a path just applying the LIMIT.
+ */
+static void
+add_paths_with_pathkeys_for_rel(PlannerInfo *root, RelOptInfo *rel)
+{
+	List	   *pathkeys;
+	bool		push_limit;
+	double		rows;
+	int			width;
+	Cost		startup_cost;
+	Cost		total_cost;
+	ForeignPath *path;
+
+	pathkeys = get_useful_pathkeys_for_relation(root, rel);
+
+	/* The LIMIT applies to the rows in the final order, if any */
+	push_limit = limit_pushdown_ok(root, rel) &&
+		(root->query_pathkeys == NIL || pathkeys != NIL);
+
+	if (pathkeys == NIL && !push_limit)
+		return;
+
+	estimate_path_cost_size(root, rel, NIL, pathkeys,
+							push_limit ? root->limit_tuples : -1.0,
+							&rows, &width, &startup_cost, &total_cost);
+
+	/* fdw_private tells postgresGetForeignPlan whether to add the LIMIT */
+	path = create_foreignscan_path(root, rel,
+								   rows,
+								   startup_cost,
+								   total_cost,
+								   pathkeys,
+								   NULL,	/* no outer rel */
+								   list_make1(makeInteger(push_limit)));
+	add_path(rel, (Path *) path);
+}
+
+/*
+ * Decide whether the join of outerrel and innerrel can be done by the
+ * remote server, and if so fill in the join's PgFdwRelationInfo.
+ */
+static bool
+foreign_join_ok(PlannerInfo *root, RelOptInfo *joinrel, JoinType jointype,
+				RelOptInfo *outerrel, RelOptInfo *innerrel,
+				JoinPathExtraData *extra)
+{
+	PgFdwRelationInfo *fpinfo = (PgFdwRelationInfo *) joinrel->fdw_private;
+	PgFdwRelationInfo *fpinfo_o = (PgFdwRelationInfo *) outerrel->fdw_private;
+	PgFdwRelationInfo *fpinfo_i = (PgFdwRelationInfo *) innerrel->fdw_private;
+	ListCell   *lc;
+
+	/* Semi- and anti-joins can't be written as a plain JOIN */
+	if (jointype != JOIN_INNER && jointype != JOIN_LEFT &&
+		jointype != JOIN_RIGHT && jointype != JOIN_FULL)
+		return false;
+
+	/*
+	 * A joined row can't be rechecked locally by EvalPlanQual, so stay away
+	 * from row locking and from the target of an UPDATE or DELETE.
+	 */
+	if (root->rowMarks != NIL ||
+		bms_is_member(root->parse->resultRelation, joinrel->relids))
+		return false;
 
-		/* Factor in the selectivity of the locally-checked quals */
-		local_sel = clauselist_selectivity(root,
-										   local_join_conds,
-										   baserel->relid,
-										   JOIN_INNER,
-										   NULL);
-		local_sel *= fpinfo->local_conds_sel;
+	/*
+	 * Both inputs must be scanned remotely with all their conditions checked
+	 * there, and as the same user.
+	 */
+	if (fpinfo_o == NULL || !fpinfo_o->pushdown_safe ||
+		fpinfo_i == NULL || !fpinfo_i->pushdown_safe)
+		return false;
+	if (fpinfo_o->local_conds != NIL || fpinfo_i->local_conds != NIL)
+		return false;
+	if (fpinfo_o->userid != fpinfo_i->userid)
+		return false;
 
-		rows = clamp_row_est(rows * local_sel);
+	/*
+	 * All the join's own conditions must be safe to send.  The ON clause of
+	 * an outer join holds those that aren't pushed down from WHERE, which go
+	 * to the WHERE clause; an inner join can keep them all in ON.  A
+	 * pseudoconstant condition would have to be applied above the join,
+	 * which isn't done for a scan of a join.
+	 */
+	fpinfo->joinclauses = NIL;
+	fpinfo->remote_conds = NIL;
+	foreach(lc, extra->restrictlist)
+	{
+		RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
 
-		/* Add in the eval cost of the locally-checked quals */
-		startup_cost += fpinfo->local_conds_cost.startup;
-		total_cost += fpinfo->local_conds_cost.per_tuple * retrieved_rows;
-		cost_qual_eval(&local_cost, local_join_conds, root);
-		startup_cost += local_cost.startup;
-		total_cost += local_cost.per_tuple * retrieved_rows;
+		if (rinfo->pseudoconstant)
+			return false;
+		if (!is_foreign_expr(root, joinrel, rinfo->clause))
+			return false;
+
+		if (jointype == JOIN_INNER || !rinfo->is_pushed_down)
+			fpinfo->joinclauses = lappend(fpinfo->joinclauses, rinfo);
+		else
+			fpinfo->remote_conds = lappend(fpinfo->remote_conds, rinfo);
 	}
-	else
+
+	/*
+	 * Pull up the conditions of the inputs.  Those of a side whose rows are
+	 * all preserved can be checked after the join, in the WHERE clause;
+	 * those of a nullable side must be checked in the ON clause, so that its
+	 * rows failing them produce nulls rather than vanish.  A full join has
+	 * no place for either.
+	 */
+	switch (jointype)
 	{
-		/*
-		 * We don't support join conditions in this mode (hence, no
-		 * parameterized paths can be made).
-		 */
-		Assert(join_conds == NIL);
+		case JOIN_INNER:
+			fpinfo->remote_conds = list_concat(fpinfo->remote_conds,
+										  list_copy(fpinfo_o->remote_conds));
+			fpinfo->remote_conds = list_concat(fpinfo->remote_conds,
+										  list_copy(fpinfo_i->remote_conds));
+			break;
+		case JOIN_LEFT:
+			fpinfo->remote_conds = list_concat(fpinfo->remote_conds,
+										  list_copy(fpinfo_o->remote_conds));
+			fpinfo->joinclauses = list_concat(fpinfo->joinclauses,
+										  list_copy(fpinfo_i->remote_conds));
+			break;
+		case JOIN_RIGHT:
+			fpinfo->remote_conds = list_concat(fpinfo->remote_conds,
+										  list_copy(fpinfo_i->remote_conds));
+			fpinfo->joinclauses = list_concat(fpinfo->joinclauses,
+										  list_copy(fpinfo_o->remote_conds));
+			break;
+		case JOIN_FULL:
+			if (fpinfo_o->remote_conds != NIL || fpinfo_i->remote_conds != NIL)
+				return false;
+			break;
+		default:
+			/* can't get here, see above */
+			return false;
+	}
 
-		/* Use rows/width estimates made by set_baserel_size_estimates. */
-		rows = baserel->rows;
-		width = baserel->width;
+	/*
+	 * The remote query fetches the columns the join must supply.  We don't
+	 * fetch whole-row references or system columns of joined tables, and
+	 * can't compute placeholders remotely.
+	 */
+	foreach(lc, joinrel->reltargetlist)
+	{
+		Var		   *var = (Var *) lfirst(lc);
 
-		/*
-		 * Back into an estimate of the number of retrieved rows.  Just in
-		 * case this is nuts, clamp to at most baserel->tuples.
-		 */
-		retrieved_rows = clamp_row_est(rows / fpinfo->local_conds_sel);
-		retrieved_rows = Min(retrieved_rows, baserel->tuples);
+		if (!IsA(var, Var) || var->varattno <= 0)
+			return false;
+	}
 
-		/*
-		 * Cost as though this were a seqscan, which is pessimistic.  We
-		 * effectively imagine the local_conds are being evaluated remotely,
-		 * too.
-		 */
-		startup_cost = 0;
-		run_cost = 0;
-		run_cost += seq_page_cost * baserel->pages;
+	/* OK, the join can be pushed down */
+	fpinfo->outerrel = outerrel;
+	fpinfo->innerrel = innerrel;
+	fpinfo->jointype = jointype;
+
+	/* Both inputs are on the same server, so take its options from either */
+	fpinfo->server = fpinfo_o->server;
+	fpinfo->userid = fpinfo_o->userid;
+	fpinfo->use_remote_estimate = fpinfo_o->use_remote_estimate ||
+		fpinfo_i->use_remote_estimate;
+	fpinfo->fdw_startup_cost = fpinfo_o->fdw_startup_cost;
+	fpinfo->fdw_tuple_cost = fpinfo_o->fdw_tuple_cost;
+	fpinfo->fetch_size = Max(fpinfo_o->fetch_size, fpinfo_i->fetch_size);
+	if (fpinfo->use_remote_estimate)
+		fpinfo->user = GetUserMapping(fpinfo->userid,
+									  fpinfo->server->serverid);
+	else
+		fpinfo->user = NULL;
 
-		startup_cost += baserel->baserestrictcost.startup;
-		cpu_per_tuple = cpu_tuple_cost + baserel->baserestrictcost.per_tuple;
-		run_cost += cpu_per_tuple * baserel->tuples;
+	/* Nothing is checked locally */
+	fpinfo->local_conds = NIL;
+	fpinfo->local_conds_sel = 1.0;
 
-		total_cost = startup_cost + run_cost;
-	}
+	fpinfo->pushdown_safe = true;
+	return true;
+}
 
-	/*
-	 * Add some additional cost factors to account for connection overhead
-	 * (fdw_startup_cost), transferring data across the network
-	 * (fdw_tuple_cost per retrieved row), and local manipulation of the data
-	 * (cpu_tuple_cost per retrieved row).
-	 */
-	startup_cost += fpinfo->fdw_startup_cost;
-	total_cost += fpinfo->fdw_startup_cost;
-	total_cost += fpinfo->fdw_tuple_cost * retrieved_rows;
-	total_cost += cpu_tuple_cost * retrieved_rows;
+/*
+ * Build the target list of the remote query for a join: the Vars the join
+ * must supply, which are all foreign_join_ok lets through.  For a foreign
+ * table, the columns are chosen by attrs_used instead, so return NIL.
+ */
+static List *
+build_tlist_to_deparse(RelOptInfo *foreignrel)
+{
+	if (foreignrel->reloptkind != RELOPT_JOINREL)
+		return NIL;
 
-	/* Return results. */
-	*p_rows = rows;
-	*p_width = width;
-	*p_startup_cost = startup_cost;
-	*p_total_cost = total_cost;
+	return add_to_flat_tlist(NIL, foreignrel->reltargetlist);
 }
 
 /*
- * Estimate costs of executing a SQL statement remotely.
- * The given "sql" must be an EXPLAIN command.
+ * Prepare for processing of parameters used in a remote query: set up the
+ * output conversion functions, the expression states that compute the
+ * values, and a buffer for the values' text form.
  */
 static void
-get_remote_estimate(const char *sql, PGconn *conn,
-					double *rows, int *width,
-					Cost *startup_cost, Cost *total_cost)
+prepare_query_params(PlanState *node,
+					 List *fdw_exprs,
+					 int numParams,
+					 FmgrInfo **param_flinfo,
+					 List **param_exprs,
+					 const char ***param_values)
 {
-	PGresult   *volatile res = NULL;
-
-	/* PGresult must be released before leaving this function. */
-	PG_TRY();
-	{
-		char	   *line;
-		char	   *p;
-		int			n;
+	int			i;
+	ListCell   *lc;
 
-		/*
-		 * Execute EXPLAIN remotely.
-		 */
-		res = PQexec(conn, sql);
-		if (PQresultStatus(res) != PGRES_TUPLES_OK)
-			pgfdw_report_error(ERROR, res, conn, false, sql);
+	Assert(numParams > 0);
 
-		/*
-		 * Extract cost numbers for topmost plan node.  Note we search for a
-		 * left paren from the end of the line to avoid being confused by
-		 * other uses of parentheses.
-		 */
-		line = PQgetvalue(res, 0, 0);
-		p = strrchr(line, '(');
-		if (p == NULL)
-			elog(ERROR, "could not interpret EXPLAIN output: \"%s\"", line);
-		n = sscanf(p, "(cost=%lf..%lf rows=%lf width=%d)",
-				   startup_cost, total_cost, rows, width);
-		if (n != 4)
-			elog(ERROR, "could not interpret EXPLAIN output: \"%s\"", line);
+	/* Prepare for output conversion of parameters used in remote query. */
+	*param_flinfo = (FmgrInfo *) palloc0(sizeof(FmgrInfo) * numParams);
 
-		PQclear(res);
-		res = NULL;
-	}
-	PG_CATCH();
+	i = 0;
+	foreach(lc, fdw_exprs)
 	{
-		if (res)
-			PQclear(res);
-		PG_RE_THROW();
+		Node	   *param_expr = (Node *) lfirst(lc);
+		Oid			typefnoid;
+		bool		isvarlena;
+
+		getTypeOutputInfo(exprType(param_expr), &typefnoid, &isvarlena);
+		fmgr_info(typefnoid, &(*param_flinfo)[i]);
+		i++;
 	}
-	PG_END_TRY();
+
+	/*
+	 * Prepare remote-parameter expressions for evaluation.  (Note: in
+	 * practice, we expect that all these expressions will be just Params, so
+	 * we could possibly do something more efficient than using the full
+	 * expression-eval machinery for this.  But probably there would be little
+	 * benefit, and it'd require postgres_fdw to know more than is desirable
+	 * about Param evaluation.)
+	 */
+	*param_exprs = (List *) ExecInitExpr((Expr *) fdw_exprs, node);
+
+	/* Allocate buffer for text form of query parameters. */
+	*param_values = (const char **) palloc0(numParams * sizeof(char *));
 }
 
 /*
- * Detect whether we want to process an EquivalenceClass member.
- *
- * This is a callback for use by generate_implied_equalities_for_column.
+ * Construct array of query parameter values in text format.
  */
-static bool
-ec_member_matches_foreign(PlannerInfo *root, RelOptInfo *rel,
-						  EquivalenceClass *ec, EquivalenceMember *em,
-						  void *arg)
+static void
+process_query_params(ExprContext *econtext,
+					 FmgrInfo *param_flinfo,
+					 List *param_exprs,
+					 const char **values)
 {
-	ec_member_foreign_arg *state = (ec_member_foreign_arg *) arg;
-	Expr	   *expr = em->em_expr;
+	int			nestlevel;
+	int			i;
+	ListCell   *lc;
 
-	/*
-	 * If we've identified what we're processing in the current scan, we only
-	 * want to match that expression.
-	 */
-	if (state->current != NULL)
-		return equal(expr, state->current);
+	nestlevel = set_transmission_modes();
 
-	/*
-	 * Otherwise, ignore anything we've already processed.
-	 */
-	if (list_member(state->already_used, expr))
-		return false;
+	i = 0;
+	foreach(lc, param_exprs)
+	{
+		ExprState  *expr_state = (ExprState *) lfirst(lc);
+		Datum		expr_value;
+		bool		isNull;
 
-	/* This is the new target to process. */
-	state->current = expr;
-	return true;
+		/* Evaluate the parameter expression */
+		expr_value = ExecEvalExpr(expr_state, econtext, &isNull, NULL);
+
+		/*
+		 * Get string representation of each parameter value by invoking
+		 * type-specific output function, unless the value is null.
+		 */
+		if (isNull)
+			values[i] = NULL;
+		else
+			values[i] = OutputFunctionCall(&param_flinfo[i], expr_value);
+		i++;
+	}
+
+	reset_transmission_modes(nestlevel);
 }
 
 /*
@@ -1953,38 +3451,14 @@ create_cursor(ForeignScanState *node)
 	 */
 	if (numParams > 0)
 	{
-		int			nestlevel;
 		MemoryContext oldcontext;
-		int			i;
-		ListCell   *lc;
 
 		oldcontext = MemoryContextSwitchTo(econtext->ecxt_per_tuple_memory);
 
-		nestlevel = set_transmission_modes();
-
-		i = 0;
-		foreach(lc, fsstate->param_exprs)
-		{
-			ExprState  *expr_state = (ExprState *) lfirst(lc);
-			Datum		expr_value;
-			bool		isNull;
-
-			/* Evaluate the parameter expression */
-			expr_value = ExecEvalExpr(expr_state, econtext, &isNull, NULL);
-
-			/*
-			 * Get string representation of each parameter value by invoking
-			 * type-specific output function, unless the value is null.
-			 */
-			if (isNull)
-				values[i] = NULL;
-			else
-				values[i] = OutputFunctionCall(&fsstate->param_flinfo[i],
-											   expr_value);
-			i++;
-		}
-
-		reset_transmission_modes(nestlevel);
+		process_query_params(econtext,
+							 fsstate->param_flinfo,
+							 fsstate->param_exprs,
+							 values);
 
 		MemoryContextSwitchTo(oldcontext);
 	}
@@ -2004,6 +3478,7 @@ create_cursor(ForeignScanState *node)
 	 * We don't use a PG_TRY block here, so be careful not to throw error
 	 * without releasing the PGresult.
 	 */
+	CompletePendingRequest(conn);
 	res = PQexecParams(conn, buf.data, numParams, NULL, values,
 					   NULL, NULL, 0);
 	if (PQresultStatus(res) != PGRES_COMMAND_OK)
@@ -2011,6 +3486,7 @@ create_cursor(ForeignScanState *node)
 	PQclear(res);
 
 	/* Mark the cursor as created, and show no tuples have been retrieved */
+	Assert(!fsstate->fetch_in_progress && !fsstate->fetch_received);
 	fsstate->cursor_exists = true;
 	fsstate->tuples = NULL;
 	fsstate->num_tuples = 0;
@@ -2023,52 +3499,114 @@ create_cursor(ForeignScanState *node)
 }
 
 /*
- * Fetch some more rows from the node's cursor.
+ * Fetch some more rows from the node's cursor, and make them the current
+ * batch.  The FETCH may have been sent, and its result received, already.
  */
 static void
 fetch_more_data(ForeignScanState *node)
 {
 	PgFdwScanState *fsstate = (PgFdwScanState *) node->fdw_state;
-	PGresult   *volatile res = NULL;
-	MemoryContext oldcontext;
+	MemoryContext cxt;
 
-	/*
-	 * We'll store the tuples in the batch_cxt.  First, flush the previous
-	 * batch.
-	 */
+	if (!fsstate->fetch_received)
+	{
+		if (!fsstate->fetch_in_progress)
+			send_fetch_request(node);
+		receive_fetch_result(node);
+	}
+
+	/* Flush the previous batch, and swap in the received one. */
 	fsstate->tuples = NULL;
 	MemoryContextReset(fsstate->batch_cxt);
-	oldcontext = MemoryContextSwitchTo(fsstate->batch_cxt);
+	cxt = fsstate->batch_cxt;
+	fsstate->batch_cxt = fsstate->fetch_cxt;
+	fsstate->fetch_cxt = cxt;
+
+	fsstate->tuples = fsstate->fetched_tuples;
+	fsstate->num_tuples = fsstate->num_fetched;
+	fsstate->next_tuple = 0;
+	fsstate->eof_reached = fsstate->fetched_eof;
+	fsstate->fetch_received = false;
+
+	/* Update fetch_ct_2 */
+	if (fsstate->fetch_ct_2 < 2)
+		fsstate->fetch_ct_2++;
+}
+
+/*
+ * Send a FETCH for the next batch of rows of the node's cursor, without
+ * waiting for its result.  Until the result is received, the connection
+ * can't be used for anything else, so register a callback that receives it
+ * when another scan of the connection wants to send something.
+ */
+static void
+send_fetch_request(ForeignScanState *node)
+{
+	PgFdwScanState *fsstate = (PgFdwScanState *) node->fdw_state;
+	PGconn	   *conn = fsstate->conn;
+	char		sql[64];
+
+	Assert(!fsstate->fetch_in_progress && !fsstate->fetch_received);
+
+	CompletePendingRequest(conn);
+
+	snprintf(sql, sizeof(sql), "FETCH %d FROM c%u",
+			 fsstate->fetch_size, fsstate->cursor_number);
+	if (!PQsendQuery(conn, sql))
+		pgfdw_report_error(ERROR, NULL, conn, false, sql);
+
+	fsstate->fetch_in_progress = true;
+	SetPendingRequest(conn, complete_pending_fetch, node);
+}
+
+/*
+ * Receive the result of the FETCH sent by send_fetch_request, waiting for
+ * it if needed.  The rows are converted into tuples kept aside until
+ * fetch_more_data makes them the current batch; the current batch is left
+ * alone, since we may get here through another scan of the connection
+ * while tuples of it are still in use.
+ */
+static void
+receive_fetch_result(ForeignScanState *node)
+{
+	PgFdwScanState *fsstate = (PgFdwScanState *) node->fdw_state;
+	PGconn	   *conn = fsstate->conn;
+	PGresult   *volatile res = NULL;
+	MemoryContext oldcontext;
+
+	Assert(fsstate->fetch_in_progress);
+
+	/* Whatever happens, the request is no longer pending */
+	fsstate->fetch_in_progress = false;
+	SetPendingRequest(conn, NULL, NULL);
+
+	MemoryContextReset(fsstate->fetch_cxt);
+	oldcontext = MemoryContextSwitchTo(fsstate->fetch_cxt);
 
 	/* PGresult must be released before leaving this function. */
 	PG_TRY();
 	{
-		PGconn	   *conn = fsstate->conn;
-		char		sql[64];
-		int			fetch_size;
+		PGresult   *extra;
 		int			numrows;
 		int			i;
 
-		/* The fetch size is arbitrary, but shouldn't be enormous. */
-		fetch_size = 100;
-
-		snprintf(sql, sizeof(sql), "FETCH %d FROM c%u",
-				 fetch_size, fsstate->cursor_number);
-
-		res = PQexec(conn, sql);
+		res = PQgetResult(conn);
 		/* On error, report the original query, not the FETCH. */
 		if (PQresultStatus(res) != PGRES_TUPLES_OK)
 			pgfdw_report_error(ERROR, res, conn, false, fsstate->query);
 
+		/* Absorb the end of the results, leaving the connection idle */
+		while ((extra = PQgetResult(conn)) != NULL)
+			PQclear(extra);
+
 		/* Convert the data into HeapTuples */
 		numrows = PQntuples(res);
-		fsstate->tuples = (HeapTuple *) palloc0(numrows * sizeof(HeapTuple));
-		fsstate->num_tuples = numrows;
-		fsstate->next_tuple = 0;
+		fsstate->fetched_tuples = (HeapTuple *) palloc0(numrows * sizeof(HeapTuple));
+		fsstate->num_fetched = numrows;
 
 		for (i = 0; i < numrows; i++)
 		{
-			fsstate->tuples[i] =
+			fsstate->fetched_tuples[i] =
 				make_tuple_from_result_row(res, i,
 										   fsstate->rel,
 										   fsstate->attinmeta,
@@ -2076,12 +3614,9 @@ fetch_more_data(ForeignScanState *node)
 										   fsstate->temp_cxt);
 		}
 
-		/* Update fetch_ct_2 */
-		if (fsstate->fetch_ct_2 < 2)
-			fsstate->fetch_ct_2++;
-
 		/* Must be EOF if we didn't get as many tuples as we asked for. */
-		fsstate->eof_reached = (numrows < fetch_size);
+		fsstate->fetched_eof = (numrows < fsstate->fetch_size);
+		fsstate->fetch_received = true;
 
 		PQclear(res);
 		res = NULL;
@@ -2097,6 +3632,34 @@ fetch_more_data(ForeignScanState *node)
 	MemoryContextSwitchTo(oldcontext);
 }
 
+/*
+ * PendingRequestCallback for a FETCH sent by send_fetch_request.
+ */
+static void
+complete_pending_fetch(void *arg)
+{
+	receive_fetch_result((ForeignScanState *) arg);
+}
+
+/*
+ * Forget about a batch fetched ahead of time, without waiting for a FETCH
+ * still in progress to finish.
+ */
+static void
+abandon_fetch(PgFdwScanState *fsstate)
+{
+	if (fsstate->fetch_in_progress)
+	{
+		PGresult   *res;
+
+		fsstate->fetch_in_progress = false;
+		SetPendingRequest(fsstate->conn, NULL, NULL);
+		while ((res = PQgetResult(fsstate->conn)) != NULL)
+			PQclear(res);
+	}
+	fsstate->fetch_received = false;
+}
+
 /*
  * Force assorted GUC parameters to settings that ensure that we'll output
  * data values in a form that is unambiguous to the remote server.
@@ -2162,6 +3725,7 @@ close_cursor(PGconn *conn, unsigned int cursor_number)
 	 * We don't use a PG_TRY block here, so be careful not to throw error
 	 * without releasing the PGresult.
 	 */
+	CompletePendingRequest(conn);
 	res = PQexec(conn, sql);
 	if (PQresultStatus(res) != PGRES_COMMAND_OK)
 		pgfdw_report_error(ERROR, res, conn, true, sql);
@@ -2194,6 +3758,7 @@ prepare_foreign_modify(PgFdwModifyState *fmstate)
 	 * We don't use a PG_TRY block here, so be careful not to throw error
 	 * without releasing the PGresult.
 	 */
+	CompletePendingRequest(fmstate->conn);
 	res = PQprepare(fmstate->conn,
 					p_name,
 					fmstate->query,
@@ -2399,6 +3964,7 @@ postgresAcquireSampleRowsFunc(Relation relation, int elevel,
 	ForeignServer *server;
 	UserMapping *user;
 	PGconn	   *conn;
+	int			fetch_size;
 	unsigned int cursor_number;
 	StringInfoData sql;
 	PGresult   *volatile res = NULL;
@@ -2431,6 +3997,8 @@ postgresAcquireSampleRowsFunc(Relation relation, int elevel,
 	user = GetUserMapping(relation->rd_rel->relowner, server->serverid);
 	conn = GetConnection(server, user, false);
 
+	fetch_size = get_fetch_size(server, table);
+
 	/*
 	 * Construct cursor that retrieves whole rows from remote.
 	 */
@@ -2452,7 +4020,6 @@ postgresAcquireSampleRowsFunc(Relation relation, int elevel,
 		for (;;)
 		{
 			char		fetch_sql[64];
-			int			fetch_size;
 			int			numrows;
 			int			i;
 
@@ -2465,9 +4032,6 @@ postgresAcquireSampleRowsFunc(Relation relation, int elevel,
 			 * then just adjust rowstoskip and samplerows appropriately.
 			 */
 
-			/* The fetch size is arbitrary, but shouldn't be enormous. */
-			fetch_size = 100;
-
 			/* Fetch some rows */
 			snprintf(fetch_sql, sizeof(fetch_sql), "FETCH %d FROM c%u",
 					 fetch_size, cursor_number);
@@ -2855,9 +4419,10 @@ postgresImportForeignSchema(ImportForeignSchemaStmt *stmt, Oid serverOid)
 /*
  * Create a tuple from the specified row of the PGresult.
  *
- * rel is the local representation of the foreign table, attinmeta is
- * conversion data for the rel's tupdesc, and retrieved_attrs is an
- * integer list of the table column numbers present in the PGresult.
+ * rel is the local representation of the foreign table, or NULL for a
+ * pushed-down join or aggregate, attinmeta is conversion data for the
+ * tupdesc of the tuples to build, and retrieved_attrs is an integer list of
+ * its column numbers present in the PGresult.
  * temp_context is a working context that can be reset after each tuple.
  */
 static HeapTuple
@@ -2869,7 +4434,7 @@ make_tuple_from_result_row(PGresult *res,
 						   MemoryContext temp_context)
 {
 	HeapTuple	tuple;
-	TupleDesc	tupdesc = RelationGetDescr(rel);
+	TupleDesc	tupdesc = attinmeta->tupdesc;
 	Datum	   *values;
 	bool	   *nulls;
 	ItemPointer ctid = NULL;
@@ -2987,9 +4552,21 @@ static void
 conversion_error_callback(void *arg)
 {
 	ConversionLocation *errpos = (ConversionLocation *) arg;
-	TupleDesc	tupdesc = RelationGetDescr(errpos->rel);
+	TupleDesc	tupdesc;
+
+	if (errpos->cur_attno <= 0)
+		return;
+
+	/* A join or aggregate has no relation, just a list of expressions */
+	if (errpos->rel == NULL)
+	{
+		errcontext("processing expression at position %d in select list",
+				   errpos->cur_attno);
+		return;
+	}
 
-	if (errpos->cur_attno > 0 && errpos->cur_attno <= tupdesc->natts)
+	tupdesc = RelationGetDescr(errpos->rel);
+	if (errpos->cur_attno <= tupdesc->natts)
 		errcontext("column \"%s\" of foreign table \"%s\"",
 				   NameStr(tupdesc->attrs[errpos->cur_attno - 1]->attname),
 				   RelationGetRelationName(errpos->rel));
@@ -20,16 +20,82 @@
 
 #include "libpq-fe.h"
 
+/*
+ * FDW-specific planner information kept in RelOptInfo.fdw_private for a
+ * foreign table, or a join of foreign tables.  For a foreign table this
+ * information is collected by postgresGetForeignRelSize, for a join by
+ * postgresGetForeignJoinPaths.
+ */
+typedef struct PgFdwRelationInfo
+{
+	/*
+	 * True if the relation can be scanned by a remote query.  Always true
+	 * for a foreign table; a join is marked false if it can't be pushed down.
+	 */
+	bool		pushdown_safe;
+
+	/*
+	 * baserestrictinfo clauses, broken down into safe and unsafe subsets.
+	 * For a join, the conditions to check in the remote query's WHERE
+	 * clause; local_conds is always NIL then.
+	 */
+	List	   *remote_conds;
+	List	   *local_conds;
+
+	/* Bitmap of attr numbers we need to fetch from the remote server. */
+	Bitmapset  *attrs_used;
+
+	/* Cost and selectivity of local_conds. */
+	QualCost	local_conds_cost;
+	Selectivity local_conds_sel;
+
+	/* Estimated size and cost for a scan with baserestrictinfo quals. */
+	double		rows;
+	int			width;
+	Cost		startup_cost;
+	Cost		total_cost;
+
+	/* Same costs, but without the overhead of transferring the rows. */
+	Cost		rel_startup_cost;
+	Cost		rel_total_cost;
+
+	/* Options extracted from catalogs. */
+	bool		use_remote_estimate;
+	Cost		fdw_startup_cost;
+	Cost		fdw_tuple_cost;
+	int			fetch_size;
+
+	/* Cached catalog information. */
+	ForeignTable *table;		/* NULL for a join */
+	ForeignServer *server;
+	Oid			userid;			/* user to do the remote access as */
+	UserMapping *user;			/* only set in use_remote_estimate mode */
+
+	/* Join information, for a join */
+	RelOptInfo *outerrel;
+	RelOptInfo *innerrel;
+	JoinType	jointype;
+	List	   *joinclauses;	/* conditions for the ON clause */
+} PgFdwRelationInfo;
+
+/* Prefix of the aliases given to the tables of a pushed-down join */
+#define REL_ALIAS_PREFIX	"r"
+
 /* in postgres_fdw.c */
 extern int	set_transmission_modes(void);
 extern void reset_transmission_modes(int nestlevel);
 
 /* in connection.c */
+typedef void (*PendingRequestCallback) (void *arg);
+
 extern PGconn *GetConnection(ForeignServer *server, UserMapping *user,
 			  bool will_prep_stmt);
 extern void ReleaseConnection(PGconn *conn);
 extern unsigned int GetCursorNumber(PGconn *conn);
 extern unsigned int GetPrepStmtNumber(PGconn *conn);
+extern void SetPendingRequest(PGconn *conn, PendingRequestCallback callback,
+				  void *arg);
+extern void CompletePendingRequest(PGconn *conn);
 extern void pgfdw_report_error(int elevel, PGresult *res, PGconn *conn,
 				   bool clear, const char *sql);
 
@@ -47,21 +113,35 @@ extern void classifyConditions(PlannerInfo *root,
 extern bool is_foreign_expr(PlannerInfo *root,
 				RelOptInfo *baserel,
 				Expr *expr);
-extern void deparseSelectSql(StringInfo buf,
-				 PlannerInfo *root,
-				 RelOptInfo *baserel,
-				 Bitmapset *attrs_used,
-				 List **retrieved_attrs);
-extern void appendWhereClause(StringInfo buf,
-				  PlannerInfo *root,
-				  RelOptInfo *baserel,
-				  List *exprs,
-				  bool is_first,
-				  List **params);
+extern bool is_foreign_grouping_expr(PlannerInfo *root,
+						 RelOptInfo *input_rel,
+						 Expr *expr);
+extern void deparseSelectStmtForRel(StringInfo buf,
+						PlannerInfo *root,
+						RelOptInfo *foreignrel,
+						List *tlist,
+						List *remote_conds,
+						List *pathkeys,
+						double limit_tuples,
+						List **retrieved_attrs,
+						List **params_list);
+extern void deparseSelectStmtForGrouping(StringInfo buf,
+							 PlannerInfo *root,
+							 RelOptInfo *input_rel,
+							 List *tlist,
+							 List *remote_conds,
+							 List *having_quals,
+							 List **retrieved_attrs,
+							 List **params_list);
+extern const char *get_jointype_name(JoinType jointype);
+extern Expr *find_em_expr_for_rel(EquivalenceClass *ec, RelOptInfo *rel);
 extern void deparseInsertSql(StringInfo buf, PlannerInfo *root,
 				 Index rtindex, Relation rel,
 				 List *targetAttrs, bool doNothing, List *returningList,
 				 List **retrieved_attrs);
+extern void deparseBatchInsertSql(StringInfo buf, Relation rel,
+					  List *targetAttrs, int nrows, bool trig_after_row,
+					  List **retrieved_attrs);
 extern void deparseUpdateSql(StringInfo buf, PlannerInfo *root,
 				 Index rtindex, Relation rel,
 				 List *targetAttrs, List *returningList,
@@ -70,6 +150,18 @@ extern void deparseDeleteSql(StringInfo buf, PlannerInfo *root,
 				 Index rtindex, Relation rel,
 				 List *returningList,
 				 List **retrieved_attrs);
+extern void deparseDirectUpdateSql(StringInfo buf, PlannerInfo *root,
+					   Index rtindex, Relation rel,
+					   RelOptInfo *foreignrel,
+					   List *targetlist,
+					   List *targetAttrs,
+					   List *remote_conds,
+					   List **params_list);
+extern void deparseDirectDeleteSql(StringInfo buf, PlannerInfo *root,
+					   Index rtindex, Relation rel,
+					   RelOptInfo *foreignrel,
+					   List *remote_conds,
+					   List **params_list);
 extern void deparseAnalyzeSizeSql(StringInfo buf, Relation rel);
 extern void deparseAnalyzeSql(StringInfo buf, Relation rel,
 				  List **retrieved_attrs);
@@ -97,6 +97,8 @@ ALTER SERVER testserver1 OPTIONS (
 	updatable 'true',
 	fdw_startup_cost '123.456',
 	fdw_tuple_cost '0.123',
+	fetch_size '100',
+	batch_size '100',
 	service 'value',
 	connect_timeout 'value',
 	dbname 'value',
@@ -215,6 +217,29 @@ WHERE a.c2 = 6 AND b.c1 = a.c1 AND a.c8 = 'foo' AND b.c7 = upper(a.c7);
 SELECT * FROM ft1 WHERE c1 = ANY (ARRAY(SELECT c1 FROM ft2 WHERE c1 < 5));
 SELECT * FROM ft2 WHERE c1 = ANY (ARRAY(SELECT c1 FROM ft1 WHERE c1 < 5));
 
+-- ===================================================================
+-- join, aggregate, ORDER BY and LIMIT pushdown
+-- ===================================================================
+-- inner join, sorted and limited remotely
+EXPLAIN (VERBOSE, COSTS false)
+SELECT t1.c1, t2.c1 FROM ft1 t1 JOIN ft2 t2 ON (t1.c1 = t2.c1) ORDER BY t1.c3, t1.c1 OFFSET 100 LIMIT 10;
+SELECT t1.c1, t2.c1 FROM ft1 t1 JOIN ft2 t2 ON (t1.c1 = t2.c1) ORDER BY t1.c3, t1.c1 OFFSET 100 LIMIT 10;
+-- left join; conditions on the nullable side go to the ON clause
+EXPLAIN (VERBOSE, COSTS false)
+SELECT t1.c1, t2.c2 FROM ft1 t1 LEFT JOIN ft2 t2 ON (t1.c1 = t2.c1 AND t2.c2 = 1) WHERE t1.c1 < 4 ORDER BY t1.c1 LIMIT 10;
+SELECT t1.c1, t2.c2 FROM ft1 t1 LEFT JOIN ft2 t2 ON (t1.c1 = t2.c1 AND t2.c2 = 1) WHERE t1.c1 < 4 ORDER BY t1.c1 LIMIT 10;
+-- aggregates and grouping
+EXPLAIN (VERBOSE, COSTS false)
+SELECT c2, count(*), sum(c1) FROM ft1 WHERE c2 < 3 GROUP BY c2 ORDER BY c2;
+SELECT c2, count(*), sum(c1) FROM ft1 WHERE c2 < 3 GROUP BY c2 ORDER BY c2;
+EXPLAIN (VERBOSE, COSTS false)
+SELECT c2, count(*) FROM ft2 GROUP BY c2 HAVING avg(c1) < 500 ORDER BY c2;
+SELECT c2, count(*) FROM ft2 GROUP BY c2 HAVING avg(c1) < 500 ORDER BY c2;
+-- aggregate over a pushed-down join
+EXPLAIN (VERBOSE, COSTS false)
+SELECT count(*) FROM ft1 t1 JOIN ft2 t2 ON (t1.c1 = t2.c1) WHERE t1.c2 = 1;
+SELECT count(*) FROM ft1 t1 JOIN ft2 t2 ON (t1.c1 = t2.c1) WHERE t1.c2 = 1;
+
 -- ===================================================================
 -- parameterized queries
 -- ===================================================================
@@ -339,6 +364,8 @@ INSERT INTO ft2 (c1,c2,c3) SELECT c1+1000,c2+100, c3 || c3 FROM ft2 LIMIT 20;
 INSERT INTO ft2 (c1,c2,c3)
   VALUES (1101,201,'aaa'), (1102,202,'bbb'), (1103,203,'ccc') RETURNING *;
 INSERT INTO ft2 (c1,c2,c3) VALUES (1104,204,'ddd'), (1105,205,'eee');
+EXPLAIN (verbose, costs off)
+UPDATE ft2 SET c2 = c2 + 300, c3 = c3 || '_update3' WHERE c1 % 10 = 3;  -- can be pushed down
 UPDATE ft2 SET c2 = c2 + 300, c3 = c3 || '_update3' WHERE c1 % 10 = 3;
 UPDATE ft2 SET c2 = c2 + 400, c3 = c3 || '_update7' WHERE c1 % 10 = 7 RETURNING *;
 EXPLAIN (verbose, costs off)
@@ -346,6 +373,8 @@ UPDATE ft2 SET c2 = ft2.c2 + 500, c3 = ft2.c3 || '_update9', c7 = DEFAULT
   FROM ft1 WHERE ft1.c1 = ft2.c2 AND ft1.c1 % 10 = 9;
 UPDATE ft2 SET c2 = ft2.c2 + 500, c3 = ft2.c3 || '_update9', c7 = DEFAULT
   FROM ft1 WHERE ft1.c1 = ft2.c2 AND ft1.c1 % 10 = 9;
+EXPLAIN (verbose, costs off)
+DELETE FROM ft2 WHERE c1 % 10 = 5;  -- can be pushed down
 EXPLAIN (verbose, costs off)
   DELETE FROM ft2 WHERE c1 % 10 = 5 RETURNING c1, c4;
 DELETE FROM ft2 WHERE c1 % 10 = 5 RETURNING c1, c4;
@@ -452,6 +481,57 @@ insert into rem1(f2) values('bye remote');
 select * from loc1;
 select * from rem1;
 
+-- ===================================================================
+-- test COPY FROM
+-- ===================================================================
+create table loc2 (f1 int, f2 text);
+create foreign table rem2 (f1 int, f2 text)
+  server loopback options(table_name 'loc2');
+copy rem2 from stdin;
+1	foo
+2	bar
+\.
+select * from rem2;
+copy rem2(f2) from stdin;
+baz
+\.
+select * from loc2;
+drop foreign table rem2;
+drop table loc2;
+
+-- ===================================================================
+-- test batched INSERT
+-- ===================================================================
+create table loc3 (f1 int, f2 text);
+create foreign table rem3 (f1 int, f2 text)
+  server loopback options(table_name 'loc3', batch_size '2');
+explain (verbose, costs off)
+insert into rem3 values (1, 'foo'), (2, 'bar'), (3, 'baz');
+insert into rem3 values (1, 'foo'), (2, 'bar'), (3, 'baz'), (4, 'qux'), (5, 'quux');
+select * from loc3 order by f1;
+-- RETURNING needs each row back, so it disables batching
+insert into rem3 values (6, 'corge') returning *;
+drop foreign table rem3;
+drop table loc3;
+
+-- ===================================================================
+-- test asynchronous execution
+-- ===================================================================
+create table async_p (a int, b text);
+create table async_loc1 (a int, b text);
+create table async_loc2 (a int, b text);
+create foreign table async_rem1 () inherits (async_p)
+  server loopback options (table_name 'async_loc1', async_capable 'true');
+create foreign table async_rem2 () inherits (async_p)
+  server loopback options (table_name 'async_loc2', async_capable 'true');
+insert into async_loc1 select i, 'r1' from generate_series(1, 150) i;
+insert into async_loc2 select i, 'r2' from generate_series(151, 300) i;
+select count(*), sum(a) from async_p;
+select a, b from async_p where a % 50 = 0 order by a;
+drop table async_p cascade;
+drop table async_loc1;
+drop table async_loc2;
+
 -- ===================================================================
 -- test local triggers
 -- ===================================================================
@@ -0,0 +1,40 @@
+-- predictability
+SET synchronous_commit = on;
+SET logical_decoding_work_mem = '64kB';
+
+SELECT 'init' FROM pg_create_logical_replication_slot('regression_slot', 'test_decoding');
+
+CREATE TABLE stream_test(data text);
+
+-- consume DDL
+SELECT data FROM pg_logical_slot_get_changes('regression_slot', NULL, NULL, 'include-xids', '0', 'skip-empty-xacts', '1');
+
+-- a large transaction gets streamed in several blocks before it commits
+INSERT INTO stream_test SELECT repeat('a', 100) || g.i FROM generate_series(1, 1000) g(i);
+
+SELECT count(*) FILTER (WHERE data LIKE 'opening a streamed block%') > 1 AS streamed,
+    count(*) FILTER (WHERE data LIKE 'opening a streamed block%') =
+    count(*) FILTER (WHERE data LIKE 'closing a streamed block%') AS balanced,
+    count(*) FILTER (WHERE data LIKE 'table public.stream_test: INSERT%') AS inserts,
+    count(*) FILTER (WHERE data LIKE 'committing streamed transaction%') AS commits
+FROM pg_logical_slot_get_changes('regression_slot', NULL, NULL, 'include-xids', '0', 'skip-empty-xacts', '1', 'stream-changes', '1');
+
+-- the output plugin is told to discard the changes of an aborted one
+BEGIN;
+INSERT INTO stream_test SELECT repeat('a', 100) || g.i FROM generate_series(1, 1000) g(i);
+ROLLBACK;
+
+SELECT count(*) FILTER (WHERE data LIKE 'opening a streamed block%') > 1 AS streamed,
+    count(*) FILTER (WHERE data LIKE 'aborting streamed (sub)transaction%') AS aborts,
+    count(*) FILTER (WHERE data LIKE 'committing streamed transaction%') AS commits
+FROM pg_logical_slot_get_changes('regression_slot', NULL, NULL, 'include-xids', '0', 'skip-empty-xacts', '1', 'stream-changes', '1');
+
+-- without stream-changes, the same transaction is decoded at commit
+INSERT INTO stream_test SELECT repeat('a', 100) || g.i FROM generate_series(1, 1000) g(i);
+
+SELECT count(*) FILTER (WHERE data LIKE 'opening a streamed block%') AS streamed,
+    count(*) FILTER (WHERE data LIKE 'table public.stream_test: INSERT%') AS inserts
+FROM pg_logical_slot_get_changes('regression_slot', NULL, NULL, 'include-xids', '0', 'skip-empty-xacts', '1');
+
+DROP TABLE stream_test;
+SELECT pg_drop_replication_slot('regression_slot');
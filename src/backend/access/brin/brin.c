@@ -27,13 +27,18 @@
 #include "catalog/index.h"
 #include "miscadmin.h"
 #include "pgstat.h"
+#include "postmaster/autovacuum.h"
 #include "storage/bufmgr.h"
 #include "storage/freespace.h"
+#include "utils/builtins.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
 #include "utils/snapmgr.h"
 
 
+/* brinsummarize's pageRange argument to process the whole table */
+#define BRIN_ALL_BLOCKRANGES	InvalidBlockNumber
+
 /*
  * We use a BrinBuildState during initial construction of a BRIN index.
  * The running state is kept in a BrinMemTuple.
@@ -64,7 +69,8 @@ static BrinBuildState *initialize_brin_buildstate(Relation idxRel,
 						   BrinRevmap *revmap, BlockNumber pagesPerRange);
 static void terminate_brin_buildstate(BrinBuildState *state);
 static void brinsummarize(Relation index, Relation heapRel,
-			  double *numSummarized, double *numExisting);
+			  BlockNumber pageRange, double *numSummarized,
+			  double *numExisting);
 static void form_and_insert_tuple(BrinBuildState *state);
 static void union_tuples(BrinDesc *bdesc, BrinMemTuple *a,
 			 BrinTuple *b);
@@ -94,9 +100,34 @@ brininsert(PG_FUNCTION_ARGS)
 	Buffer		buf = InvalidBuffer;
 	MemoryContext tupcxt = NULL;
 	MemoryContext oldcxt = NULL;
+	BlockNumber origHeapBlk;
 
 	revmap = brinRevmapInitialize(idxRel, &pagesPerRange);
 
+	/*
+	 * If auto-summarization is enabled and this is the first tuple inserted
+	 * into the first block of a page range other than the first, the
+	 * previous range has presumably been filled.  Ask autovacuum to
+	 * summarize it, if that hasn't been done yet.  If the request can't be
+	 * queued, the range is left for the next VACUUM as usual.
+	 */
+	origHeapBlk = ItemPointerGetBlockNumber(heaptid);
+	if (BrinGetAutoSummarize(idxRel) &&
+		origHeapBlk > 0 && origHeapBlk % pagesPerRange == 0 &&
+		ItemPointerGetOffsetNumber(heaptid) == FirstOffsetNumber)
+	{
+		BlockNumber lastPageRange = origHeapBlk - pagesPerRange;
+		OffsetNumber off;
+
+		if (brinGetTupleForHeapBlock(revmap, lastPageRange, &buf, &off, NULL,
+									 BUFFER_LOCK_SHARE) == NULL)
+			(void) AutoVacuumRequestWork(AVW_BRINSummarizeRange,
+										 RelationGetRelid(idxRel),
+										 lastPageRange);
+		else
+			LockBuffer(buf, BUFFER_LOCK_UNLOCK);
+	}
+
 	for (;;)
 	{
 		bool		need_insert = false;
@@ -728,7 +759,7 @@ brinvacuumcleanup(PG_FUNCTION_ARGS)
 	heapRel = heap_open(IndexGetRelation(RelationGetRelid(info->index), false),
 						AccessShareLock);
 
-	brinsummarize(info->index, heapRel,
+	brinsummarize(info->index, heapRel, BRIN_ALL_BLOCKRANGES,
 				  &stats->num_index_tuples, &stats->num_index_tuples);
 
 	heap_close(heapRel, AccessShareLock);
@@ -748,7 +779,8 @@ brinoptions(PG_FUNCTION_ARGS)
 	BrinOptions *rdopts;
 	int			numoptions;
 	static const relopt_parse_elt tab[] = {
-		{"pages_per_range", RELOPT_TYPE_INT, offsetof(BrinOptions, pagesPerRange)}
+		{"pages_per_range", RELOPT_TYPE_INT, offsetof(BrinOptions, pagesPerRange)},
+		{"autosummarize", RELOPT_TYPE_BOOL, offsetof(BrinOptions, autosummarize)}
 	};
 
 	options = parseRelOptions(reloptions, validate, RELOPT_KIND_BRIN,
@@ -784,7 +816,48 @@ brin_summarize_new_values(PG_FUNCTION_ARGS)
 						ShareUpdateExclusiveLock);
 	indexRel = index_open(indexoid, ShareUpdateExclusiveLock);
 
-	brinsummarize(indexRel, heapRel, &numSummarized, NULL);
+	brinsummarize(indexRel, heapRel, BRIN_ALL_BLOCKRANGES,
+				  &numSummarized, NULL);
+
+	relation_close(indexRel, ShareUpdateExclusiveLock);
+	relation_close(heapRel, ShareUpdateExclusiveLock);
+
+	PG_RETURN_INT32((int32) numSummarized);
+}
+
+/*
+ * SQL-callable function to summarize the page range containing the given
+ * heap block, if it isn't summarized already.  This is also what autovacuum
+ * runs for automatic summarization.  Returns the number of ranges
+ * summarized, that is zero or one.
+ */
+Datum
+brin_summarize_range(PG_FUNCTION_ARGS)
+{
+	Oid			indexoid = PG_GETARG_OID(0);
+	int64		heapBlk64 = PG_GETARG_INT64(1);
+	Relation	indexRel;
+	Relation	heapRel;
+	double		numSummarized = 0;
+
+	if (heapBlk64 < 0 || heapBlk64 > MaxBlockNumber)
+		ereport(ERROR,
+				(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+				 errmsg("block number out of range: " INT64_FORMAT,
+						heapBlk64)));
+
+	heapRel = heap_open(IndexGetRelation(indexoid, false),
+						ShareUpdateExclusiveLock);
+	indexRel = index_open(indexoid, ShareUpdateExclusiveLock);
+
+	if (indexRel->rd_rel->relam != BRIN_AM_OID)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("\"%s\" is not a BRIN index",
+						RelationGetRelationName(indexRel))));
+
+	brinsummarize(indexRel, heapRel, (BlockNumber) heapBlk64,
+				  &numSummarized, NULL);
 
 	relation_close(indexRel, ShareUpdateExclusiveLock);
 	relation_close(heapRel, ShareUpdateExclusiveLock);
@@ -1013,25 +1086,39 @@ summarize_range(IndexInfo *indexInfo, BrinBuildState *state, Relation heapRel,
  * incremented.
  */
 static void
-brinsummarize(Relation index, Relation heapRel, double *numSummarized,
-			  double *numExisting)
+brinsummarize(Relation index, Relation heapRel, BlockNumber pageRange,
+			  double *numSummarized, double *numExisting)
 {
 	BrinRevmap *revmap;
 	BrinBuildState *state = NULL;
 	IndexInfo  *indexInfo = NULL;
 	BlockNumber heapNumBlocks;
+	BlockNumber startBlk;
 	BlockNumber heapBlk;
 	BlockNumber pagesPerRange;
 	Buffer		buf;
 
 	revmap = brinRevmapInitialize(index, &pagesPerRange);
 
+	/*
+	 * Unless asked for all of them, consider only the range containing
+	 * pageRange.  A range beyond the end of the table has nothing to
+	 * summarize.
+	 */
+	heapNumBlocks = RelationGetNumberOfBlocks(heapRel);
+	if (pageRange == BRIN_ALL_BLOCKRANGES)
+		startBlk = 0;
+	else
+	{
+		startBlk = (pageRange / pagesPerRange) * pagesPerRange;
+		heapNumBlocks = Min(heapNumBlocks, startBlk + 1);
+	}
+
 	/*
 	 * Scan the revmap to find unsummarized items.
 	 */
 	buf = InvalidBuffer;
-	heapNumBlocks = RelationGetNumberOfBlocks(heapRel);
-	for (heapBlk = 0; heapBlk < heapNumBlocks; heapBlk += pagesPerRange)
+	for (heapBlk = startBlk; heapBlk < heapNumBlocks; heapBlk += pagesPerRange)
 	{
 		BrinTuple  *tup;
 		OffsetNumber off;
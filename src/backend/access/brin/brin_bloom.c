@@ -0,0 +1,363 @@
+/*
+ * brin_bloom.c
+ *		Implementation of Bloom opclass for BRIN
+ *
+ * A Bloom filter summarizes the set of values in a page range so that we can
+ * answer "might this range contain value X?" with no false negatives and a
+ * small rate of false positives.  Unlike minmax, this doesn't depend on the
+ * values being correlated with their physical location, so it is good for
+ * equality searches on columns whose values are scattered all over the
+ * table, such as identifiers or hashes.  It can't support inequalities.
+ *
+ * The filter is stored as a single bytea value per page range.  Its size is
+ * derived from pages_per_range, assuming that BLOOM_DISTINCT_FRACTION of the
+ * tuples that fit in the range have distinct values and aiming for
+ * BLOOM_FALSE_POSITIVE_RATE; it is capped so that the index tuple still fits
+ * on a page.  Values are hashed with the type's hash support function
+ * (procedure 15, the same function a hash index would use), and the bit
+ * positions for the k "hash functions" are derived from that by double
+ * hashing.
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * IDENTIFICATION
+ *	  src/backend/access/brin/brin_bloom.c
+ */
+#include "postgres.h"
+
+#include <math.h>
+
+#include "access/brin.h"
+#include "access/brin_internal.h"
+#include "access/brin_tuple.h"
+#include "access/genam.h"
+#include "access/hash.h"
+#include "access/htup_details.h"
+#include "catalog/pg_type.h"
+#include "utils/datum.h"
+#include "utils/rel.h"
+
+
+/*
+ * Additional SQL level support functions
+ *
+ * Procedure numbers must not use values reserved for BRIN itself; see
+ * brin_internal.h.  Also, support procedures of different opclasses that
+ * share a number should take the same arguments, which is why this doesn't
+ * use any of the inclusion opclasses' numbers.
+ */
+#define		PROCNUM_HASH			15	/* required */
+
+/* assumed fraction of distinct values among the tuples of a range */
+#define BLOOM_DISTINCT_FRACTION		0.1
+/* target false positive rate */
+#define BLOOM_FALSE_POSITIVE_RATE	0.01
+/* bounds for the filter size, in bytes, and the number of hash functions */
+#define BLOOM_MIN_FILTER_SIZE		128
+#define BLOOM_MAX_FILTER_SIZE		(BLCKSZ / 2)
+#define BLOOM_MAX_HASHES			16
+/* seed for the second hash value */
+#define BLOOM_SEED					0x71d67fff
+
+/*
+ * The stored summary.  Since at least BLOOM_MIN_FILTER_SIZE bytes of bitmap
+ * are always present, the tuple forming code never converts this to a short
+ * varlena, so we can update it in place.
+ */
+typedef struct BloomFilter
+{
+	int32		vl_len_;		/* varlena header (do not touch directly!) */
+	uint16		nhashes;		/* number of hash functions */
+	uint32		nbits;			/* number of bits in the bitmap */
+	uint8		bitmap[FLEXIBLE_ARRAY_MEMBER];
+} BloomFilter;
+
+typedef struct BloomOpaque
+{
+	FmgrInfo	hash_procinfo;
+} BloomOpaque;
+
+Datum		brin_bloom_opcinfo(PG_FUNCTION_ARGS);
+Datum		brin_bloom_add_value(PG_FUNCTION_ARGS);
+Datum		brin_bloom_consistent(PG_FUNCTION_ARGS);
+Datum		brin_bloom_union(PG_FUNCTION_ARGS);
+static BloomFilter *bloom_init(BrinDesc *bdesc);
+static bool bloom_add_hash(BloomFilter *filter, uint32 hash);
+static bool bloom_contains_hash(BloomFilter *filter, uint32 hash);
+static uint32 bloom_hash_value(BrinDesc *bdesc, uint16 attno, Oid colloid,
+				 Datum value);
+
+
+Datum
+brin_bloom_opcinfo(PG_FUNCTION_ARGS)
+{
+	BrinOpcInfo *result;
+
+	/*
+	 * opaque->hash_procinfo is initialized lazily; here it is set to
+	 * uninitialized by palloc0 which sets fn_oid to InvalidOid.
+	 */
+	result = palloc0(MAXALIGN(SizeofBrinOpcInfo(1)) + sizeof(BloomOpaque));
+	result->oi_nstored = 1;
+	result->oi_opaque = (BloomOpaque *)
+		MAXALIGN((char *) result + SizeofBrinOpcInfo(1));
+	result->oi_typcache[0] = lookup_type_cache(BYTEAOID, 0);
+
+	PG_RETURN_POINTER(result);
+}
+
+/*
+ * Add the hash of the new value to the range's filter.  Return true if that
+ * set any bit that wasn't already set, meaning the index tuple needs to be
+ * updated.
+ */
+Datum
+brin_bloom_add_value(PG_FUNCTION_ARGS)
+{
+	BrinDesc   *bdesc = (BrinDesc *) PG_GETARG_POINTER(0);
+	BrinValues *column = (BrinValues *) PG_GETARG_POINTER(1);
+	Datum		newval = PG_GETARG_DATUM(2);
+	bool		isnull = PG_GETARG_DATUM(3);
+	Oid			colloid = PG_GET_COLLATION();
+	BloomFilter *filter;
+	uint32		hash;
+	bool		updated = false;
+
+	/*
+	 * If the new value is null, we record that we saw it if it's the first
+	 * one; otherwise, there's nothing to do.
+	 */
+	if (isnull)
+	{
+		if (column->bv_hasnulls)
+			PG_RETURN_BOOL(false);
+
+		column->bv_hasnulls = true;
+		PG_RETURN_BOOL(true);
+	}
+
+	/* If the range had no values yet, start with an empty filter */
+	if (column->bv_allnulls)
+	{
+		column->bv_values[0] = PointerGetDatum(bloom_init(bdesc));
+		column->bv_allnulls = false;
+		updated = true;
+	}
+
+	filter = (BloomFilter *) DatumGetPointer(column->bv_values[0]);
+	Assert(VARATT_IS_4B_U(filter));
+
+	hash = bloom_hash_value(bdesc, column->bv_attno, colloid, newval);
+	updated |= bloom_add_hash(filter, hash);
+
+	PG_RETURN_BOOL(updated);
+}
+
+/*
+ * Given an index tuple corresponding to a certain page range and a scan key,
+ * return whether the scan key could match a value in the range, that is,
+ * whether all the bits for the key's hash are set in the filter.
+ */
+Datum
+brin_bloom_consistent(PG_FUNCTION_ARGS)
+{
+	BrinDesc   *bdesc = (BrinDesc *) PG_GETARG_POINTER(0);
+	BrinValues *column = (BrinValues *) PG_GETARG_POINTER(1);
+	ScanKey		key = (ScanKey) PG_GETARG_POINTER(2);
+	Oid			colloid = PG_GET_COLLATION();
+	BloomFilter *filter;
+	uint32		hash;
+
+	Assert(key->sk_attno == column->bv_attno);
+
+	/* handle IS NULL/IS NOT NULL tests */
+	if (key->sk_flags & SK_ISNULL)
+	{
+		if (key->sk_flags & SK_SEARCHNULL)
+		{
+			if (column->bv_allnulls || column->bv_hasnulls)
+				PG_RETURN_BOOL(true);
+			PG_RETURN_BOOL(false);
+		}
+
+		/*
+		 * For IS NOT NULL, we can only skip ranges that are known to have
+		 * only nulls.
+		 */
+		Assert(key->sk_flags & SK_SEARCHNOTNULL);
+		PG_RETURN_BOOL(!column->bv_allnulls);
+	}
+
+	/* if the range is all empty, it cannot possibly be consistent */
+	if (column->bv_allnulls)
+		PG_RETURN_BOOL(false);
+
+	if (key->sk_strategy != HTEqualStrategyNumber)
+		elog(ERROR, "invalid strategy number %d", key->sk_strategy);
+
+	filter = (BloomFilter *) PG_DETOAST_DATUM(column->bv_values[0]);
+	hash = bloom_hash_value(bdesc, key->sk_attno, colloid, key->sk_argument);
+
+	PG_RETURN_BOOL(bloom_contains_hash(filter, hash));
+}
+
+/*
+ * Given two BrinValues, update the first of them as a union of the summary
+ * values contained in both.  The second one is untouched.
+ */
+Datum
+brin_bloom_union(PG_FUNCTION_ARGS)
+{
+	BrinValues *col_a = (BrinValues *) PG_GETARG_POINTER(1);
+	BrinValues *col_b = (BrinValues *) PG_GETARG_POINTER(2);
+	BloomFilter *filter_a;
+	BloomFilter *filter_b;
+	int			i;
+	int			nbytes;
+
+	Assert(col_a->bv_attno == col_b->bv_attno);
+
+	/* Adjust "hasnulls" */
+	if (!col_a->bv_hasnulls && col_b->bv_hasnulls)
+		col_a->bv_hasnulls = true;
+
+	/* If there are no values in B, there's nothing left to do */
+	if (col_b->bv_allnulls)
+		PG_RETURN_VOID();
+
+	/*
+	 * Adjust "allnulls".  If A doesn't have values, just copy the values from
+	 * B into A, and we're done.
+	 */
+	if (col_a->bv_allnulls)
+	{
+		col_a->bv_allnulls = false;
+		col_a->bv_values[0] = datumCopy(col_b->bv_values[0], false, -1);
+		PG_RETURN_VOID();
+	}
+
+	filter_a = (BloomFilter *) DatumGetPointer(col_a->bv_values[0]);
+	filter_b = (BloomFilter *) PG_DETOAST_DATUM(col_b->bv_values[0]);
+	Assert(VARATT_IS_4B_U(filter_a));
+
+	/* both were sized from the same reloptions, so this shouldn't happen */
+	if (filter_a->nbits != filter_b->nbits ||
+		filter_a->nhashes != filter_b->nhashes)
+		elog(ERROR, "cannot merge BRIN bloom filters of different sizes");
+
+	nbytes = filter_a->nbits / BITS_PER_BYTE;
+	for (i = 0; i < nbytes; i++)
+		filter_a->bitmap[i] |= filter_b->bitmap[i];
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * Create an empty filter sized for the index's pages_per_range.
+ *
+ * The cap on the size is divided among the index's columns, so that an
+ * index with several bloom columns still has tuples that fit on a page.
+ */
+static BloomFilter *
+bloom_init(BrinDesc *bdesc)
+{
+	BlockNumber pagesPerRange = BrinGetPagesPerRange(bdesc->bd_index);
+	double		ndistinct;
+	double		nbits;
+	int			nbytes;
+	int			maxbytes;
+	int			nhashes;
+	BloomFilter *filter;
+
+	ndistinct = (double) MaxHeapTuplesPerPage * pagesPerRange *
+		BLOOM_DISTINCT_FRACTION;
+	ndistinct = Max(ndistinct, 1.0);
+
+	/* the optimal number of bits is -n ln(p) / (ln 2)^2 */
+	nbits = -ndistinct * log(BLOOM_FALSE_POSITIVE_RATE) / (M_LN2 * M_LN2);
+
+	maxbytes = Max(BLOOM_MAX_FILTER_SIZE / bdesc->bd_tupdesc->natts,
+				   BLOOM_MIN_FILTER_SIZE);
+	nbytes = (int) Min(ceil(nbits / BITS_PER_BYTE), (double) maxbytes);
+	nbytes = Max(nbytes, BLOOM_MIN_FILTER_SIZE);
+
+	/* and the optimal number of hash functions for that is (m / n) ln 2 */
+	nhashes = (int) rint((double) nbytes * BITS_PER_BYTE / ndistinct * M_LN2);
+	nhashes = Max(Min(nhashes, BLOOM_MAX_HASHES), 1);
+
+	filter = (BloomFilter *) palloc0(offsetof(BloomFilter, bitmap) + nbytes);
+	SET_VARSIZE(filter, offsetof(BloomFilter, bitmap) + nbytes);
+	filter->nhashes = nhashes;
+	filter->nbits = nbytes * BITS_PER_BYTE;
+
+	return filter;
+}
+
+/*
+ * Set the bits for the given hash value.  Return true if any of them wasn't
+ * set before.
+ *
+ * Rather than computing k independent hashes, we derive the k bit positions
+ * as h1 + i * h2, which is known to work as well for Bloom filters.
+ */
+static bool
+bloom_add_hash(BloomFilter *filter, uint32 hash)
+{
+	uint32		h2 = DatumGetUInt32(hash_uint32(hash ^ BLOOM_SEED));
+	bool		changed = false;
+	int			i;
+
+	for (i = 0; i < filter->nhashes; i++)
+	{
+		uint32		bit = ((uint64) hash + (uint64) i * h2) % filter->nbits;
+		uint8		mask = 1 << (bit % BITS_PER_BYTE);
+
+		if (!(filter->bitmap[bit / BITS_PER_BYTE] & mask))
+		{
+			filter->bitmap[bit / BITS_PER_BYTE] |= mask;
+			changed = true;
+		}
+	}
+
+	return changed;
+}
+
+/*
+ * Are all the bits for the given hash value set?
+ */
+static bool
+bloom_contains_hash(BloomFilter *filter, uint32 hash)
+{
+	uint32		h2 = DatumGetUInt32(hash_uint32(hash ^ BLOOM_SEED));
+	int			i;
+
+	for (i = 0; i < filter->nhashes; i++)
+	{
+		uint32		bit = ((uint64) hash + (uint64) i * h2) % filter->nbits;
+
+		if (!(filter->bitmap[bit / BITS_PER_BYTE] & (1 << (bit % BITS_PER_BYTE))))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Hash a value of the indexed column with the opclass' hash procedure, which
+ * we cache in the opaque struct to avoid repetitive syscache lookups.
+ */
+static uint32
+bloom_hash_value(BrinDesc *bdesc, uint16 attno, Oid colloid, Datum value)
+{
+	BloomOpaque *opaque;
+
+	opaque = (BloomOpaque *) bdesc->bd_info[attno - 1]->oi_opaque;
+	if (opaque->hash_procinfo.fn_oid == InvalidOid)
+		fmgr_info_copy(&opaque->hash_procinfo,
+					   index_getprocinfo(bdesc->bd_index, attno, PROCNUM_HASH),
+					   bdesc->bd_context);
+
+	return DatumGetUInt32(FunctionCall1Coll(&opaque->hash_procinfo, colloid,
+											value));
+}
@@ -0,0 +1,698 @@
+/*
+ * brin_minmax_multi.c
+ *		Implementation of multi-range Min/Max opclass for BRIN
+ *
+ * The plain minmax opclass keeps one [min, max] interval per page range, so
+ * a single outlier in a range makes the interval cover almost everything and
+ * the range can no longer be skipped.  This happens easily once data is only
+ * approximately ordered, e.g. in log tables with late-arriving rows.  Here we
+ * instead keep up to MINMAX_MULTI_MAX_RANGES disjoint intervals per range.  A
+ * value not covered by any interval is added as a new single-point interval;
+ * when that makes too many, the two adjacent intervals separated by the
+ * smallest gap are merged into one.  The gap is measured with a
+ * type-specific distance support function (procedure 11), which is why this
+ * opclass is only provided for types where such a distance is meaningful.
+ *
+ * The intervals are stored as a single bytea value per page range, holding
+ * the boundaries back to back.  Only fixed-length types are supported.
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * IDENTIFICATION
+ *	  src/backend/access/brin/brin_minmax_multi.c
+ */
+#include "postgres.h"
+
+#include "access/brin_internal.h"
+#include "access/brin_tuple.h"
+#include "access/genam.h"
+#include "access/stratnum.h"
+#include "catalog/pg_amop.h"
+#include "catalog/pg_type.h"
+#include "utils/builtins.h"
+#include "utils/date.h"
+#include "utils/datum.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/syscache.h"
+#include "utils/timestamp.h"
+
+
+/*
+ * Additional SQL level support functions
+ *
+ * Procedure numbers must not use values reserved for BRIN itself; see
+ * brin_internal.h.
+ */
+#define		PROCNUM_DISTANCE		11	/* required */
+
+/* maximum number of intervals kept per page range */
+#define MINMAX_MULTI_MAX_RANGES		32
+
+typedef struct MinmaxMultiOpaque
+{
+	FmgrInfo	distance_procinfo;
+	Oid			cached_subtype;
+	FmgrInfo	strategy_procinfos[BTMaxStrategyNumber];
+} MinmaxMultiOpaque;
+
+/*
+ * On-disk representation: nranges pairs of (lower, upper) boundary values,
+ * each typlen bytes, in ascending order.
+ */
+typedef struct SerializedRanges
+{
+	int32		vl_len_;		/* varlena header (do not touch directly!) */
+	int32		nranges;
+	char		data[FLEXIBLE_ARRAY_MEMBER];
+} SerializedRanges;
+
+/*
+ * In-memory representation.  There's room for twice as many intervals as we
+ * keep, so that two summaries can be combined before reducing the result.
+ * By-reference values point into the SerializedRanges we were deserialized
+ * from, or into the caller's new value.
+ */
+typedef struct Ranges
+{
+	int			nranges;
+	Datum		lower[2 * MINMAX_MULTI_MAX_RANGES];
+	Datum		upper[2 * MINMAX_MULTI_MAX_RANGES];
+} Ranges;
+
+Datum		brin_minmax_multi_opcinfo(PG_FUNCTION_ARGS);
+Datum		brin_minmax_multi_add_value(PG_FUNCTION_ARGS);
+Datum		brin_minmax_multi_consistent(PG_FUNCTION_ARGS);
+Datum		brin_minmax_multi_union(PG_FUNCTION_ARGS);
+Datum		brin_minmax_multi_distance_int4(PG_FUNCTION_ARGS);
+Datum		brin_minmax_multi_distance_int8(PG_FUNCTION_ARGS);
+Datum		brin_minmax_multi_distance_float8(PG_FUNCTION_ARGS);
+Datum		brin_minmax_multi_distance_date(PG_FUNCTION_ARGS);
+Datum		brin_minmax_multi_distance_timestamp(PG_FUNCTION_ARGS);
+static Ranges *ranges_deserialize(Form_pg_attribute attr, Datum value);
+static Datum ranges_serialize(Form_pg_attribute attr, Ranges *ranges);
+static void ranges_reduce(BrinDesc *bdesc, uint16 attno, Oid colloid,
+			  Ranges *ranges, int maxranges);
+static bool ranges_compare(BrinDesc *bdesc, uint16 attno, Oid colloid,
+			   Oid subtype, uint16 strategynum, Datum a, Datum b);
+static FmgrInfo *minmax_multi_get_strategy_procinfo(BrinDesc *bdesc,
+								   uint16 attno, Oid subtype,
+								   uint16 strategynum);
+
+
+Datum
+brin_minmax_multi_opcinfo(PG_FUNCTION_ARGS)
+{
+	Oid			typoid = PG_GETARG_OID(0);
+	BrinOpcInfo *result;
+
+	if (get_typlen(typoid) <= 0)
+		elog(ERROR, "minmax multi opclass does not support variable-length type %s",
+			 format_type_be(typoid));
+
+	/*
+	 * opaque's procinfos are initialized lazily; here they are set to
+	 * all-uninitialized by palloc0 which sets fn_oid to InvalidOid.
+	 */
+	result = palloc0(MAXALIGN(SizeofBrinOpcInfo(1)) +
+					 sizeof(MinmaxMultiOpaque));
+	result->oi_nstored = 1;
+	result->oi_opaque = (MinmaxMultiOpaque *)
+		MAXALIGN((char *) result + SizeofBrinOpcInfo(1));
+	result->oi_typcache[0] = lookup_type_cache(BYTEAOID, 0);
+
+	PG_RETURN_POINTER(result);
+}
+
+/*
+ * Examine the given index tuple (which contains partial status of a certain
+ * page range) by comparing it to the given value that comes from another heap
+ * tuple.  If the new value is not within any of the intervals, add it and
+ * return true.  Otherwise, return false and do not modify in this case.
+ */
+Datum
+brin_minmax_multi_add_value(PG_FUNCTION_ARGS)
+{
+	BrinDesc   *bdesc = (BrinDesc *) PG_GETARG_POINTER(0);
+	BrinValues *column = (BrinValues *) PG_GETARG_POINTER(1);
+	Datum		newval = PG_GETARG_DATUM(2);
+	bool		isnull = PG_GETARG_DATUM(3);
+	Oid			colloid = PG_GET_COLLATION();
+	AttrNumber	attno;
+	Form_pg_attribute attr;
+	Ranges	   *ranges;
+	Datum		oldval;
+	int			i;
+
+	/*
+	 * If the new value is null, we record that we saw it if it's the first
+	 * one; otherwise, there's nothing to do.
+	 */
+	if (isnull)
+	{
+		if (column->bv_hasnulls)
+			PG_RETURN_BOOL(false);
+
+		column->bv_hasnulls = true;
+		PG_RETURN_BOOL(true);
+	}
+
+	attno = column->bv_attno;
+	attr = bdesc->bd_tupdesc->attrs[attno - 1];
+
+	/*
+	 * If the recorded value is null, store the new value (which we know to be
+	 * not null) as the only interval, and we're done.
+	 */
+	if (column->bv_allnulls)
+	{
+		ranges = palloc(sizeof(Ranges));
+		ranges->nranges = 1;
+		ranges->lower[0] = ranges->upper[0] = newval;
+		column->bv_values[0] = ranges_serialize(attr, ranges);
+		column->bv_allnulls = false;
+		pfree(ranges);
+		PG_RETURN_BOOL(true);
+	}
+
+	ranges = ranges_deserialize(attr, column->bv_values[0]);
+
+	/* find the first interval that doesn't end below the new value */
+	for (i = 0; i < ranges->nranges; i++)
+	{
+		if (!ranges_compare(bdesc, attno, colloid, attr->atttypid,
+							BTGreaterStrategyNumber, newval, ranges->upper[i]))
+			break;
+	}
+
+	/* nothing to do if the value falls within that interval */
+	if (i < ranges->nranges &&
+		ranges_compare(bdesc, attno, colloid, attr->atttypid,
+					   BTGreaterEqualStrategyNumber,
+					   newval, ranges->lower[i]))
+	{
+		pfree(ranges);
+		PG_RETURN_BOOL(false);
+	}
+
+	/* otherwise insert a single-point interval before it */
+	memmove(&ranges->lower[i + 1], &ranges->lower[i],
+			(ranges->nranges - i) * sizeof(Datum));
+	memmove(&ranges->upper[i + 1], &ranges->upper[i],
+			(ranges->nranges - i) * sizeof(Datum));
+	ranges->lower[i] = ranges->upper[i] = newval;
+	ranges->nranges++;
+
+	ranges_reduce(bdesc, attno, colloid, ranges, MINMAX_MULTI_MAX_RANGES);
+
+	/* serialize before freeing the old value that ranges may point into */
+	oldval = column->bv_values[0];
+	column->bv_values[0] = ranges_serialize(attr, ranges);
+	pfree(DatumGetPointer(oldval));
+	pfree(ranges);
+
+	PG_RETURN_BOOL(true);
+}
+
+/*
+ * Given an index tuple corresponding to a certain page range and a scan key,
+ * return whether the scan key is consistent with the index tuple's
+ * intervals.  Return true if so, false otherwise.
+ */
+Datum
+brin_minmax_multi_consistent(PG_FUNCTION_ARGS)
+{
+	BrinDesc   *bdesc = (BrinDesc *) PG_GETARG_POINTER(0);
+	BrinValues *column = (BrinValues *) PG_GETARG_POINTER(1);
+	ScanKey		key = (ScanKey) PG_GETARG_POINTER(2);
+	Oid			colloid = PG_GET_COLLATION(),
+				subtype;
+	AttrNumber	attno;
+	Datum		value;
+	Ranges	   *ranges;
+	bool		matches = false;
+	int			i;
+
+	Assert(key->sk_attno == column->bv_attno);
+
+	/* handle IS NULL/IS NOT NULL tests */
+	if (key->sk_flags & SK_ISNULL)
+	{
+		if (key->sk_flags & SK_SEARCHNULL)
+		{
+			if (column->bv_allnulls || column->bv_hasnulls)
+				PG_RETURN_BOOL(true);
+			PG_RETURN_BOOL(false);
+		}
+
+		/*
+		 * For IS NOT NULL, we can only skip ranges that are known to have
+		 * only nulls.
+		 */
+		Assert(key->sk_flags & SK_SEARCHNOTNULL);
+		PG_RETURN_BOOL(!column->bv_allnulls);
+	}
+
+	/* if the range is all empty, it cannot possibly be consistent */
+	if (column->bv_allnulls)
+		PG_RETURN_BOOL(false);
+
+	attno = key->sk_attno;
+	subtype = key->sk_subtype;
+	value = key->sk_argument;
+	ranges = ranges_deserialize(bdesc->bd_tupdesc->attrs[attno - 1],
+								column->bv_values[0]);
+
+	switch (key->sk_strategy)
+	{
+		case BTLessStrategyNumber:
+		case BTLessEqualStrategyNumber:
+			/* only the overall minimum matters */
+			matches = ranges_compare(bdesc, attno, colloid, subtype,
+									 key->sk_strategy,
+									 ranges->lower[0], value);
+			break;
+		case BTEqualStrategyNumber:
+
+			/*
+			 * In the equality case (WHERE col = someval), we want to return
+			 * the current page range if any of the intervals contains the
+			 * scan key.
+			 */
+			for (i = 0; i < ranges->nranges && !matches; i++)
+			{
+				matches = ranges_compare(bdesc, attno, colloid, subtype,
+										 BTLessEqualStrategyNumber,
+										 ranges->lower[i], value) &&
+					ranges_compare(bdesc, attno, colloid, subtype,
+								   BTGreaterEqualStrategyNumber,
+								   ranges->upper[i], value);
+			}
+			break;
+		case BTGreaterEqualStrategyNumber:
+		case BTGreaterStrategyNumber:
+			/* only the overall maximum matters */
+			matches = ranges_compare(bdesc, attno, colloid, subtype,
+									 key->sk_strategy,
+									 ranges->upper[ranges->nranges - 1],
+									 value);
+			break;
+		default:
+			/* shouldn't happen */
+			elog(ERROR, "invalid strategy number %d", key->sk_strategy);
+			break;
+	}
+
+	PG_RETURN_BOOL(matches);
+}
+
+/*
+ * Given two BrinValues, update the first of them as a union of the summary
+ * values contained in both.  The second one is untouched.
+ */
+Datum
+brin_minmax_multi_union(PG_FUNCTION_ARGS)
+{
+	BrinDesc   *bdesc = (BrinDesc *) PG_GETARG_POINTER(0);
+	BrinValues *col_a = (BrinValues *) PG_GETARG_POINTER(1);
+	BrinValues *col_b = (BrinValues *) PG_GETARG_POINTER(2);
+	Oid			colloid = PG_GET_COLLATION();
+	AttrNumber	attno;
+	Form_pg_attribute attr;
+	Ranges	   *ranges_a;
+	Ranges	   *ranges_b;
+	Ranges	   *merged;
+	Datum		oldval;
+	int			ia = 0,
+				ib = 0;
+
+	Assert(col_a->bv_attno == col_b->bv_attno);
+
+	/* Adjust "hasnulls" */
+	if (!col_a->bv_hasnulls && col_b->bv_hasnulls)
+		col_a->bv_hasnulls = true;
+
+	/* If there are no values in B, there's nothing left to do */
+	if (col_b->bv_allnulls)
+		PG_RETURN_VOID();
+
+	attno = col_a->bv_attno;
+	attr = bdesc->bd_tupdesc->attrs[attno - 1];
+
+	/*
+	 * Adjust "allnulls".  If A doesn't have values, just copy the values from
+	 * B into A, and we're done.
+	 */
+	if (col_a->bv_allnulls)
+	{
+		col_a->bv_allnulls = false;
+		col_a->bv_values[0] = datumCopy(col_b->bv_values[0], false, -1);
+		PG_RETURN_VOID();
+	}
+
+	ranges_a = ranges_deserialize(attr, col_a->bv_values[0]);
+	ranges_b = ranges_deserialize(attr, col_b->bv_values[0]);
+
+	/*
+	 * Merge the two sorted lists by lower boundary, coalescing intervals that
+	 * overlap.  The result can have up to twice the usual number.
+	 */
+	merged = palloc(sizeof(Ranges));
+	merged->nranges = 0;
+	while (ia < ranges_a->nranges || ib < ranges_b->nranges)
+	{
+		Datum		lower;
+		Datum		upper;
+		int			n = merged->nranges;
+
+		if (ib >= ranges_b->nranges ||
+			(ia < ranges_a->nranges &&
+			 ranges_compare(bdesc, attno, colloid, attr->atttypid,
+							BTLessEqualStrategyNumber,
+							ranges_a->lower[ia], ranges_b->lower[ib])))
+		{
+			lower = ranges_a->lower[ia];
+			upper = ranges_a->upper[ia];
+			ia++;
+		}
+		else
+		{
+			lower = ranges_b->lower[ib];
+			upper = ranges_b->upper[ib];
+			ib++;
+		}
+
+		if (n > 0 &&
+			ranges_compare(bdesc, attno, colloid, attr->atttypid,
+						   BTLessEqualStrategyNumber,
+						   lower, merged->upper[n - 1]))
+		{
+			/* overlaps the previous interval; extend that if needed */
+			if (ranges_compare(bdesc, attno, colloid, attr->atttypid,
+							   BTGreaterStrategyNumber,
+							   upper, merged->upper[n - 1]))
+				merged->upper[n - 1] = upper;
+		}
+		else
+		{
+			merged->lower[n] = lower;
+			merged->upper[n] = upper;
+			merged->nranges++;
+		}
+	}
+
+	ranges_reduce(bdesc, attno, colloid, merged, MINMAX_MULTI_MAX_RANGES);
+
+	/* serialize before freeing the old value that merged may point into */
+	oldval = col_a->bv_values[0];
+	col_a->bv_values[0] = ranges_serialize(attr, merged);
+	pfree(DatumGetPointer(oldval));
+
+	pfree(merged);
+	pfree(ranges_a);
+	pfree(ranges_b);
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * Distance functions, used to decide which intervals to merge.  They need
+ * only be meaningful relative to each other, so we compute them in float8.
+ */
+Datum
+brin_minmax_multi_distance_int4(PG_FUNCTION_ARGS)
+{
+	int32		a = PG_GETARG_INT32(0);
+	int32		b = PG_GETARG_INT32(1);
+
+	PG_RETURN_FLOAT8((double) b - (double) a);
+}
+
+Datum
+brin_minmax_multi_distance_int8(PG_FUNCTION_ARGS)
+{
+	int64		a = PG_GETARG_INT64(0);
+	int64		b = PG_GETARG_INT64(1);
+
+	PG_RETURN_FLOAT8((double) b - (double) a);
+}
+
+Datum
+brin_minmax_multi_distance_float8(PG_FUNCTION_ARGS)
+{
+	float8		a = PG_GETARG_FLOAT8(0);
+	float8		b = PG_GETARG_FLOAT8(1);
+
+	PG_RETURN_FLOAT8(b - a);
+}
+
+Datum
+brin_minmax_multi_distance_date(PG_FUNCTION_ARGS)
+{
+	DateADT		a = PG_GETARG_DATEADT(0);
+	DateADT		b = PG_GETARG_DATEADT(1);
+
+	PG_RETURN_FLOAT8((double) b - (double) a);
+}
+
+/* also used for timestamptz, which has the same representation */
+Datum
+brin_minmax_multi_distance_timestamp(PG_FUNCTION_ARGS)
+{
+	Timestamp	a = PG_GETARG_TIMESTAMP(0);
+	Timestamp	b = PG_GETARG_TIMESTAMP(1);
+
+	PG_RETURN_FLOAT8((double) b - (double) a);
+}
+
+/*
+ * Turn the stored bytea into a Ranges struct.  By-reference values point into
+ * the (possibly detoasted) bytea, which must therefore outlive the result.
+ */
+static Ranges *
+ranges_deserialize(Form_pg_attribute attr, Datum value)
+{
+	SerializedRanges *serialized = (SerializedRanges *) PG_DETOAST_DATUM(value);
+	Ranges	   *ranges = palloc(sizeof(Ranges));
+	char	   *ptr = serialized->data;
+	int			i;
+
+	Assert(serialized->nranges > 0 &&
+		   serialized->nranges <= MINMAX_MULTI_MAX_RANGES);
+
+	ranges->nranges = serialized->nranges;
+	for (i = 0; i < 2 * ranges->nranges; i++)
+	{
+		Datum		datum;
+
+		if (!attr->attbyval)
+			datum = PointerGetDatum(ptr);
+		else if (attr->attlen == sizeof(char))
+			datum = CharGetDatum(*ptr);
+		else if (attr->attlen == sizeof(int16))
+		{
+			int16		v;
+
+			memcpy(&v, ptr, sizeof(v));
+			datum = Int16GetDatum(v);
+		}
+		else if (attr->attlen == sizeof(int32))
+		{
+			int32		v;
+
+			memcpy(&v, ptr, sizeof(v));
+			datum = Int32GetDatum(v);
+		}
+		else
+		{
+			Assert(attr->attlen == sizeof(Datum));
+			memcpy(&datum, ptr, sizeof(Datum));
+		}
+
+		if (i % 2 == 0)
+			ranges->lower[i / 2] = datum;
+		else
+			ranges->upper[i / 2] = datum;
+		ptr += attr->attlen;
+	}
+
+	return ranges;
+}
+
+/*
+ * Build the bytea to store from a Ranges struct.
+ */
+static Datum
+ranges_serialize(Form_pg_attribute attr, Ranges *ranges)
+{
+	Size		len;
+	SerializedRanges *serialized;
+	char	   *ptr;
+	int			i;
+
+	Assert(ranges->nranges > 0 &&
+		   ranges->nranges <= MINMAX_MULTI_MAX_RANGES);
+
+	len = offsetof(SerializedRanges, data) +
+		2 * ranges->nranges * attr->attlen;
+	serialized = palloc(len);
+	SET_VARSIZE(serialized, len);
+	serialized->nranges = ranges->nranges;
+
+	ptr = serialized->data;
+	for (i = 0; i < 2 * ranges->nranges; i++)
+	{
+		Datum		datum = (i % 2 == 0) ? ranges->lower[i / 2] :
+		ranges->upper[i / 2];
+
+		if (!attr->attbyval)
+			memcpy(ptr, DatumGetPointer(datum), attr->attlen);
+		else if (attr->attlen == sizeof(char))
+			*ptr = DatumGetChar(datum);
+		else if (attr->attlen == sizeof(int16))
+		{
+			int16		v = DatumGetInt16(datum);
+
+			memcpy(ptr, &v, sizeof(v));
+		}
+		else if (attr->attlen == sizeof(int32))
+		{
+			int32		v = DatumGetInt32(datum);
+
+			memcpy(ptr, &v, sizeof(v));
+		}
+		else
+		{
+			Assert(attr->attlen == sizeof(Datum));
+			memcpy(ptr, &datum, sizeof(Datum));
+		}
+		ptr += attr->attlen;
+	}
+
+	return PointerGetDatum(serialized);
+}
+
+/*
+ * Merge adjacent intervals, closest first, until no more than maxranges are
+ * left.
+ */
+static void
+ranges_reduce(BrinDesc *bdesc, uint16 attno, Oid colloid, Ranges *ranges,
+			  int maxranges)
+{
+	MinmaxMultiOpaque *opaque;
+
+	opaque = (MinmaxMultiOpaque *) bdesc->bd_info[attno - 1]->oi_opaque;
+	if (opaque->distance_procinfo.fn_oid == InvalidOid)
+		fmgr_info_copy(&opaque->distance_procinfo,
+					   index_getprocinfo(bdesc->bd_index, attno,
+										 PROCNUM_DISTANCE),
+					   bdesc->bd_context);
+
+	while (ranges->nranges > maxranges)
+	{
+		int			best = 0;
+		double		bestdist = 0;
+		int			i;
+
+		for (i = 0; i < ranges->nranges - 1; i++)
+		{
+			double		dist;
+
+			dist = DatumGetFloat8(FunctionCall2Coll(&opaque->distance_procinfo,
+													colloid,
+													ranges->upper[i],
+													ranges->lower[i + 1]));
+			if (i == 0 || dist < bestdist)
+			{
+				best = i;
+				bestdist = dist;
+			}
+		}
+
+		ranges->upper[best] = ranges->upper[best + 1];
+		memmove(&ranges->lower[best + 1], &ranges->lower[best + 2],
+				(ranges->nranges - best - 2) * sizeof(Datum));
+		memmove(&ranges->upper[best + 1], &ranges->upper[best + 2],
+				(ranges->nranges - best - 2) * sizeof(Datum));
+		ranges->nranges--;
+	}
+}
+
+/*
+ * Apply the opfamily's operator for the given strategy to a and b.
+ */
+static bool
+ranges_compare(BrinDesc *bdesc, uint16 attno, Oid colloid, Oid subtype,
+			   uint16 strategynum, Datum a, Datum b)
+{
+	FmgrInfo   *finfo;
+
+	finfo = minmax_multi_get_strategy_procinfo(bdesc, attno, subtype,
+											   strategynum);
+	return DatumGetBool(FunctionCall2Coll(finfo, colloid, a, b));
+}
+
+/*
+ * Cache and return the procedure for the given strategy.
+ *
+ * Note: this function mirrors minmax_get_strategy_procinfo; see notes there.
+ * If changes are made here, see that function too.
+ */
+static FmgrInfo *
+minmax_multi_get_strategy_procinfo(BrinDesc *bdesc, uint16 attno, Oid subtype,
+								   uint16 strategynum)
+{
+	MinmaxMultiOpaque *opaque;
+
+	Assert(strategynum >= 1 &&
+		   strategynum <= BTMaxStrategyNumber);
+
+	opaque = (MinmaxMultiOpaque *) bdesc->bd_info[attno - 1]->oi_opaque;
+
+	/*
+	 * We cache the procedures for the previous subtype in the opaque struct,
+	 * to avoid repetitive syscache lookups.  If the subtype changed,
+	 * invalidate all the cached entries.
+	 */
+	if (opaque->cached_subtype != subtype)
+	{
+		uint16		i;
+
+		for (i = 1; i <= BTMaxStrategyNumber; i++)
+			opaque->strategy_procinfos[i - 1].fn_oid = InvalidOid;
+		opaque->cached_subtype = subtype;
+	}
+
+	if (opaque->strategy_procinfos[strategynum - 1].fn_oid == InvalidOid)
+	{
+		Form_pg_attribute attr;
+		HeapTuple	tuple;
+		Oid			opfamily,
+					oprid;
+		bool		isNull;
+
+		opfamily = bdesc->bd_index->rd_opfamily[attno - 1];
+		attr = bdesc->bd_tupdesc->attrs[attno - 1];
+		tuple = SearchSysCache4(AMOPSTRATEGY, ObjectIdGetDatum(opfamily),
+								ObjectIdGetDatum(attr->atttypid),
+								ObjectIdGetDatum(subtype),
+								Int16GetDatum(strategynum));
+
+		if (!HeapTupleIsValid(tuple))
+			elog(ERROR, "missing operator %d(%u,%u) in opfamily %u",
+				 strategynum, attr->atttypid, subtype, opfamily);
+
+		oprid = DatumGetObjectId(SysCacheGetAttr(AMOPSTRATEGY, tuple,
+											 Anum_pg_amop_amopopr, &isNull));
+		ReleaseSysCache(tuple);
+		Assert(!isNull && RegProcedureIsValid(oprid));
+
+		fmgr_info_cxt(get_opcode(oprid),
+					  &opaque->strategy_procinfos[strategynum - 1],
+					  bdesc->bd_context);
+	}
+
+	return &opaque->strategy_procinfos[strategynum - 1];
+}
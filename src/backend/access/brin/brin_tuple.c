@@ -438,6 +438,9 @@ brin_deform_tuple(BrinDesc *brdesc, BrinTuple *tuple)
 	{
 		int			i;
 
+		/* a range may have only null values; it still has nulls then */
+		dtup->bt_columns[keyno].bv_hasnulls = hasnulls[keyno];
+
 		if (allnulls[keyno])
 		{
 			valueno += brdesc->bd_info[keyno]->oi_nstored;
@@ -454,7 +457,6 @@ brin_deform_tuple(BrinDesc *brdesc, BrinTuple *tuple)
 						  brdesc->bd_info[keyno]->oi_typcache[i]->typbyval,
 						  brdesc->bd_info[keyno]->oi_typcache[i]->typlen);
 
-		dtup->bt_columns[keyno].bv_hasnulls = hasnulls[keyno];
 		dtup->bt_columns[keyno].bv_allnulls = false;
 	}
 
@@ -1064,6 +1064,23 @@ heap_deformtuple(HeapTuple tuple,
 	pfree(boolNulls);
 }
 
+/*
+ * leading_notnull_natts
+ *		Count the attributes before the first null one, looking no further
+ *		than natts.  Whole bytes of the null bitmap are checked at once.
+ */
+static inline int
+leading_notnull_natts(bits8 *bp, int natts)
+{
+	int			attnum = 0;
+
+	while (attnum + 8 <= natts && bp[attnum >> 3] == 0xFF)
+		attnum += 8;
+	while (attnum < natts && !att_isnull(attnum, bp))
+		attnum++;
+	return attnum;
+}
+
 /*
  * slot_deform_tuple
  *		Given a TupleTableSlot, extract data from the slot's physical tuple
@@ -1090,6 +1107,7 @@ slot_deform_tuple(TupleTableSlot *slot, int natts)
 	long		off;			/* offset in tuple data */
 	bits8	   *bp = tup->t_bits;		/* ptr to null bitmap in tuple */
 	bool		slow;			/* can we use/set attcacheoff? */
+	int			nfixed;
 
 	/*
 	 * Check whether the first call for this tuple, and initialize or restore
@@ -1111,6 +1129,27 @@ slot_deform_tuple(TupleTableSlot *slot, int natts)
 
 	tp = (char *) tup + tup->t_hoff;
 
+	/*
+	 * Unless there are nulls among them, the leading fixed-width attributes
+	 * are at known offsets (see slot_fixed_natts), so fetch them with a
+	 * minimum of fuss.  A tuple with nulls only further on still qualifies,
+	 * up to its first null.
+	 */
+	nfixed = Min(natts, slot->tts_nfixed);
+	if (attnum < nfixed && !slow && hasnulls)
+		nfixed = leading_notnull_natts(bp, nfixed);
+	if (attnum < nfixed && !slow)
+	{
+		for (; attnum < nfixed; attnum++)
+		{
+			Form_pg_attribute thisatt = att[attnum];
+
+			values[attnum] = fetchatt(thisatt, tp + thisatt->attcacheoff);
+			isnull[attnum] = false;
+		}
+		off = att[attnum - 1]->attcacheoff + att[attnum - 1]->attlen;
+	}
+
 	for (; attnum < natts; attnum++)
 	{
 		Form_pg_attribute thisatt = att[attnum];
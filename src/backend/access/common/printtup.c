@@ -19,9 +19,14 @@
 #include "libpq/libpq.h"
 #include "libpq/pqformat.h"
 #include "tcop/pquery.h"
+#include "utils/builtins.h"
+#include "utils/date.h"
+#include "utils/fmgroids.h"
 #include "utils/lsyscache.h"
 #include "utils/memdebug.h"
 #include "utils/memutils.h"
+#include "utils/numeric.h"
+#include "utils/timestamp.h"
 
 
 static void printtup_startup(DestReceiver *self, int operation,
@@ -32,6 +37,8 @@ static void printtup_internal_20(TupleTableSlot *slot, DestReceiver *self);
 static void printtup_shutdown(DestReceiver *self);
 static void printtup_destroy(DestReceiver *self);
 
+static DirectSendFunc GetDirectOutputFunc(Oid typoutput);
+
 
 /* ----------------------------------------------------------------
  *		printtup / debugtup support
@@ -52,6 +59,8 @@ typedef struct
 	bool		typisvarlena;	/* is it varlena (ie possibly toastable)? */
 	int16		format;			/* format code for this column */
 	FmgrInfo	finfo;			/* Precomputed call info for output fn */
+	DirectSendFunc directsend;	/* direct variant of typsend, if any */
+	DirectSendFunc directout;	/* direct variant of typoutput, if any */
 } PrinttupAttrInfo;
 
 typedef struct
@@ -280,6 +289,7 @@ printtup_prepare_info(DR_printtup *myState, TupleDesc typeinfo, int numAttrs)
 							  &thisState->typoutput,
 							  &thisState->typisvarlena);
 			fmgr_info(thisState->typoutput, &thisState->finfo);
+			thisState->directout = GetDirectOutputFunc(thisState->typoutput);
 		}
 		else if (format == 1)
 		{
@@ -287,6 +297,7 @@ printtup_prepare_info(DR_printtup *myState, TupleDesc typeinfo, int numAttrs)
 									&thisState->typsend,
 									&thisState->typisvarlena);
 			fmgr_info(thisState->typsend, &thisState->finfo);
+			thisState->directsend = GetDirectSendFunc(thisState->typsend);
 		}
 		else
 			ereport(ERROR,
@@ -351,7 +362,12 @@ printtup(TupleTableSlot *slot, DestReceiver *self)
 			VALGRIND_CHECK_MEM_IS_DEFINED(DatumGetPointer(attr),
 										  VARSIZE_ANY(attr));
 
-		if (thisState->format == 0)
+		if (thisState->directout)
+		{
+			/* Text output, straight into the message */
+			thisState->directout(&buf, attr);
+		}
+		else if (thisState->format == 0)
 		{
 			/* Text output */
 			char	   *outputstr;
@@ -359,6 +375,11 @@ printtup(TupleTableSlot *slot, DestReceiver *self)
 			outputstr = OutputFunctionCall(&thisState->finfo, attr);
 			pq_sendcountedtext(&buf, outputstr, strlen(outputstr), false);
 		}
+		else if (thisState->directsend)
+		{
+			/* Binary output, straight into the message */
+			thisState->directsend(&buf, attr);
+		}
 		else
 		{
 			/* Binary output */
@@ -625,6 +646,12 @@ printtup_internal_20(TupleTableSlot *slot, DestReceiver *self)
 
 		Assert(thisState->format == 1);
 
+		if (thisState->directsend)
+		{
+			thisState->directsend(&buf, attr);
+			continue;
+		}
+
 		outputbytes = SendFunctionCall(&thisState->finfo, attr);
 		pq_sendint(&buf, VARSIZE(outputbytes) - VARHDRSZ, 4);
 		pq_sendbytes(&buf, VARDATA(outputbytes),
@@ -637,3 +664,196 @@ printtup_internal_20(TupleTableSlot *slot, DestReceiver *self)
 	MemoryContextSwitchTo(oldcontext);
 	MemoryContextReset(myState->tmpcontext);
 }
+
+
+/* ----------------------------------------------------------------
+ *		direct binary output support
+ *
+ * These produce the same bytes as the types' send functions, preceded by
+ * the length word, but append them straight to the message buffer instead
+ * of returning a palloc'd bytea that the caller then copies.
+ * ----------------------------------------------------------------
+ */
+
+static void
+direct_send_bool(StringInfo buf, Datum value)
+{
+	pq_sendint(buf, 1, 4);
+	pq_sendbyte(buf, DatumGetBool(value) ? 1 : 0);
+}
+
+static void
+direct_send_int2(StringInfo buf, Datum value)
+{
+	pq_sendint(buf, sizeof(int16), 4);
+	pq_sendint(buf, DatumGetInt16(value), sizeof(int16));
+}
+
+static void
+direct_send_int4(StringInfo buf, Datum value)
+{
+	pq_sendint(buf, sizeof(int32), 4);
+	pq_sendint(buf, DatumGetInt32(value), sizeof(int32));
+}
+
+static void
+direct_send_oid(StringInfo buf, Datum value)
+{
+	pq_sendint(buf, sizeof(Oid), 4);
+	pq_sendint(buf, DatumGetObjectId(value), sizeof(Oid));
+}
+
+static void
+direct_send_int8(StringInfo buf, Datum value)
+{
+	pq_sendint(buf, sizeof(int64), 4);
+	pq_sendint64(buf, DatumGetInt64(value));
+}
+
+static void
+direct_send_float4(StringInfo buf, Datum value)
+{
+	pq_sendint(buf, sizeof(float4), 4);
+	pq_sendfloat4(buf, DatumGetFloat4(value));
+}
+
+static void
+direct_send_float8(StringInfo buf, Datum value)
+{
+	pq_sendint(buf, sizeof(float8), 4);
+	pq_sendfloat8(buf, DatumGetFloat8(value));
+}
+
+static void
+direct_send_date(StringInfo buf, Datum value)
+{
+	pq_sendint(buf, sizeof(DateADT), 4);
+	pq_sendint(buf, DatumGetDateADT(value), sizeof(DateADT));
+}
+
+static void
+direct_send_timestamp(StringInfo buf, Datum value)
+{
+	pq_sendint(buf, sizeof(Timestamp), 4);
+#ifdef HAVE_INT64_TIMESTAMP
+	pq_sendint64(buf, DatumGetTimestamp(value));
+#else
+	pq_sendfloat8(buf, DatumGetTimestamp(value));
+#endif
+}
+
+/* Also serves for bpchar and varchar, like textsend itself */
+static void
+direct_send_text(StringInfo buf, Datum value)
+{
+	text	   *t = DatumGetTextPP(value);
+
+	pq_sendcountedtext(buf, VARDATA_ANY(t), VARSIZE_ANY_EXHDR(t), false);
+}
+
+static void
+direct_send_bytea(StringInfo buf, Datum value)
+{
+	bytea	   *b = DatumGetByteaPP(value);
+
+	pq_sendint(buf, VARSIZE_ANY_EXHDR(b), 4);
+	pq_sendbytes(buf, VARDATA_ANY(b), VARSIZE_ANY_EXHDR(b));
+}
+
+/*
+ * Text output of integers.  Digits are the same in every client encoding,
+ * so unlike pq_sendcountedtext we needn't call the encoding converter.
+ */
+static void
+direct_out_int2(StringInfo buf, Datum value)
+{
+	char		str[7];
+	int			len = pg_ltoa((int32) DatumGetInt16(value), str);
+
+	pq_sendint(buf, len, 4);
+	appendBinaryStringInfo(buf, str, len);
+}
+
+static void
+direct_out_int4(StringInfo buf, Datum value)
+{
+	char		str[12];
+	int			len = pg_ltoa(DatumGetInt32(value), str);
+
+	pq_sendint(buf, len, 4);
+	appendBinaryStringInfo(buf, str, len);
+}
+
+static void
+direct_out_int8(StringInfo buf, Datum value)
+{
+	char		str[21];
+	int			len = pg_lltoa(DatumGetInt64(value), str);
+
+	pq_sendint(buf, len, 4);
+	appendBinaryStringInfo(buf, str, len);
+}
+
+/*
+ * GetDirectOutputFunc
+ *		Like GetDirectSendFunc, for text output
+ */
+static DirectSendFunc
+GetDirectOutputFunc(Oid typoutput)
+{
+	switch (typoutput)
+	{
+		case F_INT2OUT:
+			return direct_out_int2;
+		case F_INT4OUT:
+			return direct_out_int4;
+		case F_INT8OUT:
+			return direct_out_int8;
+		default:
+			return NULL;
+	}
+}
+
+/*
+ * GetDirectSendFunc
+ *		Get the direct variant of a type's binary output function
+ *
+ * Returns NULL if there's none, in which case the caller must use
+ * SendFunctionCall.
+ */
+DirectSendFunc
+GetDirectSendFunc(Oid typsend)
+{
+	switch (typsend)
+	{
+		case F_BOOLSEND:
+			return direct_send_bool;
+		case F_INT2SEND:
+			return direct_send_int2;
+		case F_INT4SEND:
+			return direct_send_int4;
+		case F_OIDSEND:
+			return direct_send_oid;
+		case F_INT8SEND:
+			return direct_send_int8;
+		case F_FLOAT4SEND:
+			return direct_send_float4;
+		case F_FLOAT8SEND:
+			return direct_send_float8;
+		case F_DATE_SEND:
+			return direct_send_date;
+		case F_TIMESTAMP_SEND:
+		case F_TIMESTAMPTZ_SEND:
+			return direct_send_timestamp;
+		case F_TEXTSEND:
+		case F_BPCHARSEND:
+		case F_VARCHARSEND:
+			return direct_send_text;
+		case F_BYTEASEND:
+			return direct_send_bytea;
+		case F_NUMERIC_SEND:
+			return numeric_send_direct;
+		default:
+			return NULL;
+	}
+}
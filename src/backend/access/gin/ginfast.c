@@ -3,9 +3,10 @@
  * ginfast.c
  *	  Fast insert routines for the Postgres inverted index access method.
  *	  Pending entries are stored in linear list of pages.  Later on
- *	  (typically during VACUUM), ginInsertCleanup() will be invoked to
- *	  transfer pending entries into the regular index structure.  This
- *	  wins because bulk insertion is much more efficient than retail.
+ *	  (typically during VACUUM, or in an autovacuum worker when the list
+ *	  grows too long), ginInsertCleanup() will be invoked to transfer
+ *	  pending entries into the regular index structure.  This wins because
+ *	  bulk insertion is much more efficient than retail.
  *
  * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
  * Portions Copyright (c) 1994, Regents of the University of California
@@ -19,9 +20,14 @@
 #include "postgres.h"
 
 #include "access/gin_private.h"
+#include "access/xlog.h"
 #include "access/xloginsert.h"
+#include "catalog/pg_am.h"
 #include "commands/vacuum.h"
 #include "miscadmin.h"
+#include "postmaster/autovacuum.h"
+#include "storage/lmgr.h"
+#include "utils/acl.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
 
@@ -31,6 +37,14 @@ int			gin_pending_list_limit = 0;
 #define GIN_PAGE_FREESIZE \
 	( BLCKSZ - MAXALIGN(SizeOfPageHeaderData) - MAXALIGN(sizeof(GinPageOpaqueData)) )
 
+/*
+ * An inserter that finds the pending list over gin_pending_list_limit asks
+ * autovacuum to clean it up.  If the list nevertheless grows to this many
+ * times the limit, autovacuum isn't keeping up, and the inserter cleans up
+ * the list itself as it used to.
+ */
+#define GIN_PENDING_LIST_BACKSTOP	4
+
 typedef struct KeyArray
 {
 	Datum	   *keys;			/* expansible array */
@@ -222,7 +236,9 @@ ginHeapTupleFastInsert(GinState *ginstate, GinTupleCollector *collector)
 	ginxlogUpdateMeta data;
 	bool		separateList = false;
 	bool		needCleanup = false;
+	bool		forceCleanup = false;
 	int			cleanupSize;
+	int64		pendingSize;
 	bool		needWal;
 
 	if (collector->ntuples == 0)
@@ -425,15 +441,40 @@ ginHeapTupleFastInsert(GinState *ginstate, GinTupleCollector *collector)
 	 * ginInsertCleanup() should not be called inside our CRIT_SECTION.
 	 */
 	cleanupSize = GinGetPendingListCleanupSize(index);
-	if (metadata->nPendingPages * GIN_PAGE_FREESIZE > cleanupSize * 1024L)
+	pendingSize = (int64) metadata->nPendingPages * GIN_PAGE_FREESIZE;
+	if (pendingSize > cleanupSize * 1024L)
 		needCleanup = true;
+	if (pendingSize > GIN_PENDING_LIST_BACKSTOP * cleanupSize * 1024L)
+		forceCleanup = true;
 
 	UnlockReleaseBuffer(metabuffer);
 
 	END_CRIT_SECTION();
 
+	/*
+	 * Rather than making this inserter wait while the whole list is moved
+	 * into the main index, hand the job to autovacuum if we can.  It's enough
+	 * to ask when we've added pages to the list, which keeps the requests
+	 * infrequent; other inserters just assume the request is pending.  A
+	 * temporary index can't be processed by autovacuum at all.
+	 */
 	if (needCleanup)
-		ginInsertCleanup(ginstate, false, NULL);
+	{
+		bool		handedOff = false;
+
+		if (!forceCleanup && !RelationUsesLocalBuffers(index))
+		{
+			if (separateList)
+				handedOff = AutoVacuumRequestWork(AVW_GINCleanPendingList,
+												  RelationGetRelid(index),
+												  InvalidBlockNumber);
+			else
+				handedOff = AutoVacuumingActive();
+		}
+
+		if (!handedOff)
+			ginInsertCleanup(ginstate, false, NULL);
+	}
 }
 
 /*
@@ -725,8 +766,14 @@ processPendingPage(BuildAccumulator *accum, KeyArray *ka,
  * action of removing a page from the pending list really needs exclusive
  * lock.
  *
- * vac_delay indicates that ginInsertCleanup is called from vacuum process,
- * so call vacuum_delay_point() periodically.
+ * Only one backend at a time does the cleanup, which is serialized by a
+ * heavyweight lock on the metapage's block number.
+ *
+ * vac_delay indicates that ginInsertCleanup is called from vacuum process
+ * (or some other maintenance caller), so call vacuum_delay_point()
+ * periodically, and if another backend is already cleaning up, wait for it
+ * and then clean up anything left.  An inserter instead just leaves the
+ * work to whoever is doing it.
  * If stats isn't null, we count deleted pending pages into the counts.
  */
 void
@@ -745,6 +792,11 @@ ginInsertCleanup(GinState *ginstate,
 	KeyArray	datums;
 	BlockNumber blkno;
 
+	if (vac_delay)
+		LockPage(index, GIN_METAPAGE_BLKNO, ExclusiveLock);
+	else if (!ConditionalLockPage(index, GIN_METAPAGE_BLKNO, ExclusiveLock))
+		return;
+
 	metabuffer = ReadBuffer(index, GIN_METAPAGE_BLKNO);
 	LockBuffer(metabuffer, GIN_SHARE);
 	metapage = BufferGetPage(metabuffer);
@@ -754,6 +806,7 @@ ginInsertCleanup(GinState *ginstate,
 	{
 		/* Nothing to do */
 		UnlockReleaseBuffer(metabuffer);
+		UnlockPage(index, GIN_METAPAGE_BLKNO, ExclusiveLock);
 		return;
 	}
 
@@ -930,8 +983,62 @@ ginInsertCleanup(GinState *ginstate,
 	}
 
 	ReleaseBuffer(metabuffer);
+	UnlockPage(index, GIN_METAPAGE_BLKNO, ExclusiveLock);
 
 	/* Clean up temporary space */
 	MemoryContextSwitchTo(oldCtx);
 	MemoryContextDelete(opCtx);
 }
+
+/*
+ * SQL-callable function to move the pending list of a GIN index into the
+ * main index structure.  Returns the number of pending list pages removed.
+ *
+ * This is also what autovacuum runs when an inserter hands the cleanup to it.
+ */
+Datum
+gin_clean_pending_list(PG_FUNCTION_ARGS)
+{
+	Oid			indexoid = PG_GETARG_OID(0);
+	Relation	indexRel;
+	IndexBulkDeleteResult stats;
+	GinState	ginstate;
+
+	if (RecoveryInProgress())
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("recovery is in progress"),
+				 errhint("GIN pending list cannot be cleaned up during recovery.")));
+
+	indexRel = index_open(indexoid, RowExclusiveLock);
+
+	if (indexRel->rd_rel->relkind != RELKIND_INDEX ||
+		indexRel->rd_rel->relam != GIN_AM_OID)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("\"%s\" is not a GIN index",
+						RelationGetRelationName(indexRel))));
+
+	/*
+	 * Reject attempts to read non-local temporary relations; we would be
+	 * likely to get wrong data since we have no visibility into the owning
+	 * session's local buffers.
+	 */
+	if (RELATION_IS_OTHER_TEMP(indexRel))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			   errmsg("cannot access temporary indexes of other sessions")));
+
+	/* User must own the index (comparable to privileges needed for VACUUM) */
+	if (!pg_class_ownercheck(indexoid, GetUserId()))
+		aclcheck_error(ACLCHECK_NOT_OWNER, ACL_KIND_CLASS,
+					   RelationGetRelationName(indexRel));
+
+	memset(&stats, 0, sizeof(stats));
+	initGinState(&ginstate, indexRel);
+	ginInsertCleanup(&ginstate, true, &stats);
+
+	index_close(indexRel, RowExclusiveLock);
+
+	PG_RETURN_INT64((int64) stats.pages_deleted);
+}
@@ -571,6 +571,53 @@ startScan(IndexScanDesc scan)
 		startScanKey(ginstate, so, so->keys + i);
 }
 
+/*
+ * Find the first item in entry->list, at or after entry->offset, that is
+ * > advancePast.  Returns entry->nlist if there is none.
+ *
+ * When a frequent entry is intersected with a rare one, advancePast often
+ * jumps far ahead of the frequent entry's current position.  To avoid
+ * stepping over every item in between, we probe at exponentially growing
+ * distances until we overshoot, and then binary search the last interval.
+ * That costs about as much as a linear step for a short skip, and only
+ * logarithmic time for a long one.
+ */
+static int
+entrySkipInList(GinScanEntry entry, ItemPointerData advancePast)
+{
+	int			lo = entry->offset;
+	int			hi;
+	int			step = 1;
+
+	if (lo >= entry->nlist ||
+		ginCompareItemPointers(&entry->list[lo], &advancePast) > 0)
+		return lo;
+
+	/* entry->list[lo] <= advancePast; gallop to find an upper bound */
+	hi = lo + 1;
+	while (hi < entry->nlist &&
+		   ginCompareItemPointers(&entry->list[hi], &advancePast) <= 0)
+	{
+		lo = hi;
+		step *= 2;
+		hi = lo + step;
+	}
+	if (hi > entry->nlist)
+		hi = entry->nlist;
+
+	/* now list[lo] <= advancePast, and list[hi] > advancePast or hi == nlist */
+	while (hi - lo > 1)
+	{
+		int			mid = lo + (hi - lo) / 2;
+
+		if (ginCompareItemPointers(&entry->list[mid], &advancePast) <= 0)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return hi;
+}
+
 /*
  * Load the next batch of item pointers from a posting tree.
  *
@@ -694,22 +741,20 @@ entryLoadMoreItems(GinState *ginstate, GinScanEntry entry, ItemPointerData advan
 
 		entry->list = GinDataLeafPageGetItems(page, &entry->nlist, advancePast);
 
-		for (i = 0; i < entry->nlist; i++)
+		i = entrySkipInList(entry, advancePast);
+		if (i < entry->nlist)
 		{
-			if (ginCompareItemPointers(&advancePast, &entry->list[i]) < 0)
-			{
-				entry->offset = i;
+			entry->offset = i;
 
-				if (GinPageRightMost(page))
-				{
-					/* after processing the copied items, we're done. */
-					UnlockReleaseBuffer(entry->buffer);
-					entry->buffer = InvalidBuffer;
-				}
-				else
-					LockBuffer(entry->buffer, GIN_UNLOCK);
-				return;
+			if (GinPageRightMost(page))
+			{
+				/* after processing the copied items, we're done. */
+				UnlockReleaseBuffer(entry->buffer);
+				entry->buffer = InvalidBuffer;
 			}
+			else
+				LockBuffer(entry->buffer, GIN_UNLOCK);
+			return;
 		}
 	}
 }
@@ -834,17 +879,14 @@ entryGetItem(GinState *ginstate, GinScanEntry entry,
 		 * A posting list from an entry tuple, or the last page of a posting
 		 * tree.
 		 */
-		do
+		entry->offset = entrySkipInList(entry, advancePast);
+		if (entry->offset >= entry->nlist)
 		{
-			if (entry->offset >= entry->nlist)
-			{
-				ItemPointerSetInvalid(&entry->curItem);
-				entry->isFinished = TRUE;
-				break;
-			}
-
+			ItemPointerSetInvalid(&entry->curItem);
+			entry->isFinished = TRUE;
+		}
+		else
 			entry->curItem = entry->list[entry->offset++];
-		} while (ginCompareItemPointers(&entry->curItem, &advancePast) <= 0);
 		/* XXX: shouldn't we apply the fuzzy search limit here? */
 	}
 	else
@@ -852,7 +894,13 @@ entryGetItem(GinState *ginstate, GinScanEntry entry,
 		/* A posting tree */
 		do
 		{
-			/* If we've processed the current batch, load more items */
+			/* Skip over items <= advancePast in the current batch */
+			entry->offset = entrySkipInList(entry, advancePast);
+
+			/*
+			 * If we've processed the current batch, load more items.  That
+			 * leaves offset at the first item > advancePast.
+			 */
 			while (entry->offset >= entry->nlist)
 			{
 				entryLoadMoreItems(ginstate, entry, advancePast);
@@ -866,8 +914,7 @@ entryGetItem(GinState *ginstate, GinScanEntry entry,
 
 			entry->curItem = entry->list[entry->offset++];
 
-		} while (ginCompareItemPointers(&entry->curItem, &advancePast) <= 0 ||
-				 (entry->reduceResult == TRUE && dropItem(entry)));
+		} while (entry->reduceResult == TRUE && dropItem(entry));
 	}
 }
 
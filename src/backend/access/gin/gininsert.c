@@ -3,6 +3,17 @@
  * gininsert.c
  *	  insert routines for the postgres inverted index access method.
  *
+ * An index build accumulates the entries extracted from the heap in memory,
+ * and dumps them into the index whenever the memory fills up.  If
+ * max_parallel_maintenance_workers allows it and the heap is big enough, the
+ * heap is instead divided among background workers through a parallel heap
+ * scan.  Each worker accumulates the entries of its share in memory in the
+ * same way, but rather than dumping them into the index itself, it sends them
+ * to the leader over a shm_mq; the leader inserts everything the workers send
+ * into the index, which is thus still written by a single process.  Since
+ * extracting the entries (for example, parsing documents into tsvectors) is
+ * usually most of the work of building a GIN index, that is what we spread
+ * out.
  *
  * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
  * Portions Copyright (c) 1994, Regents of the University of California
@@ -15,16 +26,35 @@
 #include "postgres.h"
 
 #include "access/gin_private.h"
+#include "access/heapam.h"
+#include "access/parallel.h"
+#include "access/relscan.h"
+#include "access/xact.h"
 #include "access/xloginsert.h"
 #include "catalog/index.h"
 #include "miscadmin.h"
+#include "pgstat.h"
 #include "storage/bufmgr.h"
+#include "storage/shm_mq.h"
 #include "storage/smgr.h"
 #include "storage/indexfsm.h"
+#include "storage/spin.h"
+#include "utils/datum.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
 
 
+/* Magic numbers for parallel GIN build state sharing */
+#define PARALLEL_KEY_GIN_SHARED			UINT64CONST(0xA000000000000011)
+#define PARALLEL_KEY_ENTRY_QUEUE		UINT64CONST(0xA000000000000012)
+
+/* Size of each worker's queue of entries */
+#define PARALLEL_GIN_QUEUE_SIZE			65536
+
+/* Minimum accumulator memory, in kilobytes, worth giving each worker */
+#define PARALLEL_GIN_MIN_WORKMEM		32768
+
+
 typedef struct
 {
 	GinState	ginstate;
@@ -33,8 +63,73 @@ typedef struct
 	MemoryContext tmpCtx;
 	MemoryContext funcCtx;
 	BuildAccumulator accum;
+	int			workMem;		/* memory for accum, in kilobytes */
+	shm_mq_handle *queue;		/* in a worker, where to send the entries */
 } GinBuildState;
 
+/*
+ * Status record shared by the participants in a parallel GIN build.  It
+ * lives in the DSM segment set up by ginBeginParallel.
+ */
+typedef struct GinShared
+{
+	/* Fields set up by the leader and not changed afterwards */
+	Oid			heaprelid;
+	Oid			indexrelid;
+	int			workmem;		/* accumulator memory for each worker, in kB */
+
+	/* Workers' results, added in under the mutex as each finishes its scan */
+	slock_t		mutex;
+	double		reltuples;		/* heap tuples seen by workers */
+	double		indtuples;		/* entries extracted by workers */
+	bool		brokenhotchain; /* did any worker see a broken HOT chain? */
+
+	/* The parallel heap scan that divides the heap between workers */
+	ParallelHeapScanDescData heapdesc;
+} GinShared;
+
+/*
+ * Leader's private state for a parallel GIN build.
+ */
+typedef struct GinLeader
+{
+	ParallelContext *pcxt;
+	GinShared  *ginshared;
+	int			nqueues;		/* number of workers launched */
+	shm_mq_handle **queues;		/* entry queue of each worker */
+} GinLeader;
+
+/*
+ * Each message a worker sends is one of these, followed by the entry's item
+ * pointers and then, if the key type is passed by reference, the key.  A
+ * message with "end" set, and nothing else, says the worker is done.
+ */
+typedef struct GinQueueEntry
+{
+	bool		end;
+	GinNullCategory category;
+	OffsetNumber attnum;
+	uint32		nlist;			/* number of item pointers */
+	uint32		keylen;			/* length of key data, 0 if none */
+	Datum		keyval;			/* the key, if passed by value */
+} GinQueueEntry;
+
+static void ginInitBuildState(GinBuildState *buildstate, Relation index,
+				  int workMem);
+static void ginFreeBuildState(GinBuildState *buildstate);
+static void ginFlushBuildState(GinBuildState *buildstate);
+static void ginSendEntry(GinBuildState *buildstate, OffsetNumber attnum,
+			 Datum key, GinNullCategory category,
+			 ItemPointerData *list, uint32 nlist);
+static int	ginParallelDegree(Relation heap, IndexInfo *indexInfo);
+static GinLeader *ginBeginParallel(Relation heap, Relation index,
+				 int nworkers);
+static void ginParallelInsertEntries(GinBuildState *buildstate,
+						 GinLeader *ginleader);
+static void ginEndParallel(GinLeader *ginleader, IndexInfo *indexInfo,
+			   double *reltuples, double *indtuples);
+static void ginParallelBuildMain(dsm_segment *seg, shm_toc *toc);
+
 
 /*
  * Adds array of item pointers to tuple's posting list, or
@@ -281,27 +376,8 @@ ginBuildCallback(Relation index, HeapTuple htup, Datum *values,
 							   &htup->t_self);
 
 	/* If we've maxed out our available memory, dump everything to the index */
-	if (buildstate->accum.allocatedMemory >= maintenance_work_mem * 1024L)
-	{
-		ItemPointerData *list;
-		Datum		key;
-		GinNullCategory category;
-		uint32		nlist;
-		OffsetNumber attnum;
-
-		ginBeginBAScan(&buildstate->accum);
-		while ((list = ginGetBAEntry(&buildstate->accum,
-								  &attnum, &key, &category, &nlist)) != NULL)
-		{
-			/* there could be many entries, so be willing to abort here */
-			CHECK_FOR_INTERRUPTS();
-			ginEntryInsert(&buildstate->ginstate, attnum, key, category,
-						   list, nlist, &buildstate->buildStats);
-		}
-
-		MemoryContextReset(buildstate->tmpCtx);
-		ginInitBA(&buildstate->accum);
-	}
+	if (buildstate->accum.allocatedMemory >= buildstate->workMem * 1024L)
+		ginFlushBuildState(buildstate);
 
 	MemoryContextSwitchTo(oldCtx);
 }
@@ -315,22 +391,16 @@ ginbuild(PG_FUNCTION_ARGS)
 	IndexBuildResult *result;
 	double		reltuples;
 	GinBuildState buildstate;
+	GinLeader  *ginleader = NULL;
+	int			nworkers;
 	Buffer		RootBuffer,
 				MetaBuffer;
-	ItemPointerData *list;
-	Datum		key;
-	GinNullCategory category;
-	uint32		nlist;
-	MemoryContext oldCtx;
-	OffsetNumber attnum;
 
 	if (RelationGetNumberOfBlocks(index) != 0)
 		elog(ERROR, "index \"%s\" already contains data",
 			 RelationGetRelationName(index));
 
-	initGinState(&buildstate.ginstate, index);
-	buildstate.indtuples = 0;
-	memset(&buildstate.buildStats, 0, sizeof(GinStatsData));
+	ginInitBuildState(&buildstate, index, maintenance_work_mem);
 
 	/* initialize the meta page */
 	MetaBuffer = GinNewBuffer(index);
@@ -369,67 +439,466 @@ ginbuild(PG_FUNCTION_ARGS)
 	/* count the root as first entry page */
 	buildstate.buildStats.nEntryPages++;
 
+	/*
+	 * If the build is worth doing in parallel, launch the workers.  They
+	 * scan the heap between them, while we insert the entries they find.
+	 */
+	nworkers = ginParallelDegree(heap, indexInfo);
+	if (nworkers > 0)
+		ginleader = ginBeginParallel(heap, index, nworkers);
+
+	if (ginleader)
+	{
+		ginParallelInsertEntries(&buildstate, ginleader);
+		reltuples = 0;
+		ginEndParallel(ginleader, indexInfo,
+					   &reltuples, &buildstate.indtuples);
+	}
+	else
+	{
+		/*
+		 * Do the heap scan.  We disallow sync scan here because
+		 * dataPlaceToPage prefers to receive tuples in TID order.
+		 */
+		reltuples = IndexBuildHeapScan(heap, index, indexInfo, false,
+									   ginBuildCallback, (void *) &buildstate);
+
+		/* dump remaining entries to the index */
+		ginFlushBuildState(&buildstate);
+	}
+
+	ginFreeBuildState(&buildstate);
+
+	/*
+	 * Update metapage stats
+	 */
+	buildstate.buildStats.nTotalPages = RelationGetNumberOfBlocks(index);
+	ginUpdateStats(index, &buildstate.buildStats);
+
+	/*
+	 * Return statistics
+	 */
+	result = (IndexBuildResult *) palloc(sizeof(IndexBuildResult));
+
+	result->heap_tuples = reltuples;
+	result->index_tuples = buildstate.indtuples;
+
+	PG_RETURN_POINTER(result);
+}
+
+/*
+ * Set up the state for building an index, with workMem kilobytes of memory
+ * for accumulating entries.
+ */
+static void
+ginInitBuildState(GinBuildState *buildstate, Relation index, int workMem)
+{
+	initGinState(&buildstate->ginstate, index);
+	buildstate->indtuples = 0;
+	memset(&buildstate->buildStats, 0, sizeof(GinStatsData));
+	buildstate->workMem = workMem;
+	buildstate->queue = NULL;
+
 	/*
 	 * create a temporary memory context that is used to hold data not yet
 	 * dumped out to the index
 	 */
-	buildstate.tmpCtx = AllocSetContextCreate(CurrentMemoryContext,
-											  "Gin build temporary context",
-											  ALLOCSET_DEFAULT_MINSIZE,
-											  ALLOCSET_DEFAULT_INITSIZE,
-											  ALLOCSET_DEFAULT_MAXSIZE);
+	buildstate->tmpCtx = AllocSetContextCreate(CurrentMemoryContext,
+											   "Gin build temporary context",
+											   ALLOCSET_DEFAULT_MINSIZE,
+											   ALLOCSET_DEFAULT_INITSIZE,
+											   ALLOCSET_DEFAULT_MAXSIZE);
 
 	/*
 	 * create a temporary memory context that is used for calling
 	 * ginExtractEntries(), and can be reset after each tuple
 	 */
-	buildstate.funcCtx = AllocSetContextCreate(CurrentMemoryContext,
+	buildstate->funcCtx = AllocSetContextCreate(CurrentMemoryContext,
 					 "Gin build temporary context for user-defined function",
-											   ALLOCSET_DEFAULT_MINSIZE,
-											   ALLOCSET_DEFAULT_INITSIZE,
-											   ALLOCSET_DEFAULT_MAXSIZE);
+												ALLOCSET_DEFAULT_MINSIZE,
+												ALLOCSET_DEFAULT_INITSIZE,
+												ALLOCSET_DEFAULT_MAXSIZE);
 
-	buildstate.accum.ginstate = &buildstate.ginstate;
-	ginInitBA(&buildstate.accum);
+	buildstate->accum.ginstate = &buildstate->ginstate;
+	ginInitBA(&buildstate->accum);
+}
 
-	/*
-	 * Do the heap scan.  We disallow sync scan here because dataPlaceToPage
-	 * prefers to receive tuples in TID order.
-	 */
-	reltuples = IndexBuildHeapScan(heap, index, indexInfo, false,
-								   ginBuildCallback, (void *) &buildstate);
+static void
+ginFreeBuildState(GinBuildState *buildstate)
+{
+	MemoryContextDelete(buildstate->funcCtx);
+	MemoryContextDelete(buildstate->tmpCtx);
+}
+
+/*
+ * Dump the entries accumulated in memory into the index, or in a parallel
+ * worker, send them to the leader to do that.
+ */
+static void
+ginFlushBuildState(GinBuildState *buildstate)
+{
+	ItemPointerData *list;
+	Datum		key;
+	GinNullCategory category;
+	uint32		nlist;
+	OffsetNumber attnum;
+	MemoryContext oldCtx;
+
+	oldCtx = MemoryContextSwitchTo(buildstate->tmpCtx);
 
-	/* dump remaining entries to the index */
-	oldCtx = MemoryContextSwitchTo(buildstate.tmpCtx);
-	ginBeginBAScan(&buildstate.accum);
-	while ((list = ginGetBAEntry(&buildstate.accum,
+	ginBeginBAScan(&buildstate->accum);
+	while ((list = ginGetBAEntry(&buildstate->accum,
 								 &attnum, &key, &category, &nlist)) != NULL)
 	{
 		/* there could be many entries, so be willing to abort here */
 		CHECK_FOR_INTERRUPTS();
-		ginEntryInsert(&buildstate.ginstate, attnum, key, category,
-					   list, nlist, &buildstate.buildStats);
+		if (buildstate->queue != NULL)
+			ginSendEntry(buildstate, attnum, key, category, list, nlist);
+		else
+			ginEntryInsert(&buildstate->ginstate, attnum, key, category,
+						   list, nlist, &buildstate->buildStats);
 	}
+
+	MemoryContextReset(buildstate->tmpCtx);
+	ginInitBA(&buildstate->accum);
+
 	MemoryContextSwitchTo(oldCtx);
+}
+
+/*
+ * Send one accumulated entry from a worker to the leader.
+ */
+static void
+ginSendEntry(GinBuildState *buildstate, OffsetNumber attnum, Datum key,
+			 GinNullCategory category, ItemPointerData *list, uint32 nlist)
+{
+	GinQueueEntry header;
+	shm_mq_iovec iov[3];
+	int			iovcnt = 2;
+
+	memset(&header, 0, sizeof(header));
+	header.end = false;
+	header.category = category;
+	header.attnum = attnum;
+	header.nlist = nlist;
+
+	if (category == GIN_CAT_NORM_KEY)
+	{
+		Form_pg_attribute att;
+
+		att = buildstate->ginstate.origTupdesc->attrs[attnum - 1];
+		if (att->attbyval)
+			header.keyval = key;
+		else
+		{
+			header.keylen = datumGetSize(key, false, att->attlen);
+			iov[2].data = DatumGetPointer(key);
+			iov[2].len = header.keylen;
+			iovcnt = 3;
+		}
+	}
 
-	MemoryContextDelete(buildstate.funcCtx);
-	MemoryContextDelete(buildstate.tmpCtx);
+	iov[0].data = (char *) &header;
+	iov[0].len = sizeof(header);
+	iov[1].data = (char *) list;
+	iov[1].len = nlist * sizeof(ItemPointerData);
 
 	/*
-	 * Update metapage stats
+	 * If the leader has detached from the queue, it must have failed, and
+	 * there's no point in scanning any further.
 	 */
-	buildstate.buildStats.nTotalPages = RelationGetNumberOfBlocks(index);
-	ginUpdateStats(index, &buildstate.buildStats);
+	if (shm_mq_sendv(buildstate->queue, iov, iovcnt, false) != SHM_MQ_SUCCESS)
+		ereport(ERROR,
+				(errcode(ERRCODE_INTERNAL_ERROR),
+				 errmsg("lost connection to parallel index build leader")));
+}
+
+/*
+ * Decide how many workers to use for building the given index, or 0 if the
+ * build shouldn't be done in parallel.
+ */
+static int
+ginParallelDegree(Relation heap, IndexInfo *indexInfo)
+{
+	int			nworkers;
+
+	nworkers = IndexBuildParallelWorkers(heap, indexInfo);
 
 	/*
-	 * Return statistics
+	 * maintenance_work_mem is divided among the workers only, since the
+	 * leader accumulates nothing.  Don't split it into uselessly small
+	 * shares.
 	 */
-	result = (IndexBuildResult *) palloc(sizeof(IndexBuildResult));
+	while (nworkers > 0 &&
+		   maintenance_work_mem / nworkers < PARALLEL_GIN_MIN_WORKMEM)
+		nworkers--;
 
-	result->heap_tuples = reltuples;
-	result->index_tuples = buildstate.indtuples;
+	return nworkers;
+}
 
-	PG_RETURN_POINTER(result);
+/*
+ * Enter parallel mode and launch workers to scan the heap.
+ *
+ * Returns NULL, having left parallel mode again, if no worker could be
+ * started; the caller then does the scan itself.
+ */
+static GinLeader *
+ginBeginParallel(Relation heap, Relation index, int nworkers)
+{
+	GinLeader  *ginleader;
+	ParallelContext *pcxt;
+	GinShared  *ginshared;
+	char	   *equeuespace;
+	int			i;
+
+	EnterParallelMode();
+	pcxt = CreateParallelContext(ginParallelBuildMain, nworkers);
+
+	/* Estimate space for the shared state and the entry queues */
+	shm_toc_estimate_chunk(&pcxt->estimator, sizeof(GinShared));
+	shm_toc_estimate_chunk(&pcxt->estimator,
+						   PARALLEL_GIN_QUEUE_SIZE * pcxt->nworkers);
+	shm_toc_estimate_keys(&pcxt->estimator, 2);
+
+	InitializeParallelDSM(pcxt);
+
+	/* Set up the shared state */
+	ginshared = (GinShared *) shm_toc_allocate(pcxt->toc, sizeof(GinShared));
+	ginshared->heaprelid = RelationGetRelid(heap);
+	ginshared->indexrelid = RelationGetRelid(index);
+	ginshared->workmem = maintenance_work_mem / nworkers;
+	SpinLockInit(&ginshared->mutex);
+	ginshared->reltuples = 0;
+	ginshared->indtuples = 0;
+	ginshared->brokenhotchain = false;
+	heap_parallelscan_initialize(&ginshared->heapdesc, heap);
+	shm_toc_insert(pcxt->toc, PARALLEL_KEY_GIN_SHARED, ginshared);
+
+	/* Set up an entry queue for each worker, with the leader receiving */
+	equeuespace = shm_toc_allocate(pcxt->toc,
+								   PARALLEL_GIN_QUEUE_SIZE * pcxt->nworkers);
+	for (i = 0; i < pcxt->nworkers; i++)
+	{
+		shm_mq	   *mq;
+
+		mq = shm_mq_create(equeuespace + i * PARALLEL_GIN_QUEUE_SIZE,
+						   (Size) PARALLEL_GIN_QUEUE_SIZE);
+		shm_mq_set_receiver(mq, MyProc);
+	}
+	shm_toc_insert(pcxt->toc, PARALLEL_KEY_ENTRY_QUEUE, equeuespace);
+
+	LaunchParallelWorkers(pcxt);
+
+	if (pcxt->nworkers_launched == 0)
+	{
+		DestroyParallelContext(pcxt);
+		ExitParallelMode();
+		return NULL;
+	}
+
+	/* Attach to the queues of the workers that actually started */
+	ginleader = (GinLeader *) palloc0(sizeof(GinLeader));
+	ginleader->pcxt = pcxt;
+	ginleader->ginshared = ginshared;
+	ginleader->nqueues = pcxt->nworkers_launched;
+	ginleader->queues = (shm_mq_handle **)
+		palloc0(pcxt->nworkers_launched * sizeof(shm_mq_handle *));
+	for (i = 0; i < pcxt->nworkers_launched; i++)
+	{
+		shm_mq	   *mq = (shm_mq *) (equeuespace + i * PARALLEL_GIN_QUEUE_SIZE);
+
+		ginleader->queues[i] = shm_mq_attach(mq, pcxt->seg, NULL);
+		shm_mq_set_handle(ginleader->queues[i], pcxt->worker[i].bgwhandle);
+	}
+
+	return ginleader;
+}
+
+/*
+ * Insert the entries the workers send into the index, until every worker has
+ * said it's done.
+ *
+ * We take entries from whichever queue has some, so that no worker is kept
+ * waiting for us while we have anything else to do.
+ */
+static void
+ginParallelInsertEntries(GinBuildState *buildstate, GinLeader *ginleader)
+{
+	bool	   *done;
+	int			nremaining = ginleader->nqueues;
+	MemoryContext oldCtx;
+
+	done = (bool *) palloc0(ginleader->nqueues * sizeof(bool));
+
+	oldCtx = MemoryContextSwitchTo(buildstate->tmpCtx);
+
+	while (nremaining > 0)
+	{
+		bool		gotany = false;
+		int			i;
+
+		for (i = 0; i < ginleader->nqueues; i++)
+		{
+			shm_mq_result res;
+			Size		nbytes;
+			void	   *data;
+			GinQueueEntry *header;
+			ItemPointerData *list;
+			Datum		key;
+
+			if (done[i])
+				continue;
+
+			res = shm_mq_receive(ginleader->queues[i], &nbytes, &data, true);
+			if (res == SHM_MQ_WOULD_BLOCK)
+				continue;
+			if (res != SHM_MQ_SUCCESS)
+			{
+				/*
+				 * The worker went away before telling us it was done.  If
+				 * that was because of an error, it has left a message for
+				 * us; rethrow it.
+				 */
+				HandleParallelMessages();
+				ereport(ERROR,
+						(errcode(ERRCODE_INTERNAL_ERROR),
+						 errmsg("lost connection to parallel worker")));
+			}
+
+			gotany = true;
+			header = (GinQueueEntry *) data;
+			if (header->end)
+			{
+				done[i] = true;
+				nremaining--;
+				continue;
+			}
+
+			Assert(nbytes == sizeof(GinQueueEntry) +
+				   header->nlist * sizeof(ItemPointerData) + header->keylen);
+			list = (ItemPointerData *) ((char *) data + sizeof(GinQueueEntry));
+
+			/* the key data isn't aligned in the message, so copy it */
+			key = header->keyval;
+			if (header->keylen > 0)
+			{
+				char	   *keydata = palloc(header->keylen);
+
+				memcpy(keydata, (char *) (list + header->nlist),
+					   header->keylen);
+				key = PointerGetDatum(keydata);
+			}
+
+			ginEntryInsert(&buildstate->ginstate, header->attnum, key,
+						   header->category, list, header->nlist,
+						   &buildstate->buildStats);
+
+			MemoryContextReset(buildstate->tmpCtx);
+		}
+
+		if (!gotany)
+		{
+			pgstat_report_wait_start(WAIT_EVENT_GIN_BUILD_WORKERS);
+			WaitLatch(MyLatch, WL_LATCH_SET, 0);
+			pgstat_report_wait_end();
+			ResetLatch(MyLatch);
+		}
+
+		/* there could be many entries, so be willing to abort here */
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	MemoryContextSwitchTo(oldCtx);
+	pfree(done);
+}
+
+/*
+ * Wait for the workers to finish, add their counts to the leader's, and
+ * leave parallel mode.
+ */
+static void
+ginEndParallel(GinLeader *ginleader, IndexInfo *indexInfo,
+			   double *reltuples, double *indtuples)
+{
+	GinShared  *ginshared = ginleader->ginshared;
+
+	WaitForParallelWorkersToFinish(ginleader->pcxt);
+
+	/* The workers are gone, so no need for the spinlock */
+	*reltuples += ginshared->reltuples;
+	*indtuples += ginshared->indtuples;
+	if (ginshared->brokenhotchain)
+		indexInfo->ii_BrokenHotChain = true;
+
+	DestroyParallelContext(ginleader->pcxt);
+	ExitParallelMode();
+	pfree(ginleader->queues);
+	pfree(ginleader);
+}
+
+/*
+ * Main entry point for a parallel GIN build worker.
+ *
+ * The worker scans the blocks of the heap it's handed, accumulating the
+ * entries it finds, and sends them to the leader each time its memory fills
+ * up and at the end.  It has no lock of its own on the heap or the index;
+ * the leader's lock protects both until the leader has received everything
+ * and the worker has exited.
+ */
+static void
+ginParallelBuildMain(dsm_segment *seg, shm_toc *toc)
+{
+	GinShared  *ginshared;
+	char	   *equeuespace;
+	shm_mq	   *mq;
+	shm_mq_handle *mqh;
+	Relation	heapRel;
+	Relation	indexRel;
+	IndexInfo  *indexInfo;
+	GinBuildState buildstate;
+	double		reltuples;
+	GinQueueEntry header;
+
+	ginshared = (GinShared *) shm_toc_lookup(toc, PARALLEL_KEY_GIN_SHARED);
+	equeuespace = shm_toc_lookup(toc, PARALLEL_KEY_ENTRY_QUEUE);
+	if (ginshared == NULL || equeuespace == NULL)
+		elog(ERROR, "could not find parallel index build state");
+
+	mq = (shm_mq *) (equeuespace +
+					 ParallelWorkerNumber * PARALLEL_GIN_QUEUE_SIZE);
+	shm_mq_set_sender(mq, MyProc);
+	mqh = shm_mq_attach(mq, seg, NULL);
+
+	heapRel = heap_open(ginshared->heaprelid, NoLock);
+	indexRel = index_open(ginshared->indexrelid, NoLock);
+	indexInfo = BuildIndexInfo(indexRel);
+
+	ginInitBuildState(&buildstate, indexRel, ginshared->workmem);
+	buildstate.queue = mqh;
+
+	/* Scan our share of the heap, sending entries as memory fills up */
+	reltuples = IndexBuildHeapParallelScan(heapRel, indexRel, indexInfo,
+										   &ginshared->heapdesc,
+									  ginBuildCallback, (void *) &buildstate);
+	ginFlushBuildState(&buildstate);
+
+	/* Report our counts to the leader */
+	SpinLockAcquire(&ginshared->mutex);
+	ginshared->reltuples += reltuples;
+	ginshared->indtuples += buildstate.indtuples;
+	if (indexInfo->ii_BrokenHotChain)
+		ginshared->brokenhotchain = true;
+	SpinLockRelease(&ginshared->mutex);
+
+	/* Tell the leader we're done */
+	memset(&header, 0, sizeof(header));
+	header.end = true;
+	(void) shm_mq_send(mqh, sizeof(header), &header, false);
+
+	ginFreeBuildState(&buildstate);
+
+	index_close(indexRel, NoLock);
+	heap_close(heapRel, NoLock);
 }
 
 /*
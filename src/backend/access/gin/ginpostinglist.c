@@ -62,6 +62,13 @@
  * that holds for removing items from a posting list, you must also be
  * careful to not cause expansion e.g. when merging uncompressed items on the
  * page into the compressed lists, when vacuuming.
+ *
+ * Decoding speed matters more than encoding speed, since posting lists are
+ * decoded by every scan that touches them.  Consecutive TIDs on the same heap
+ * page, which is the common case for a frequent key, differ by less than 128
+ * and so are encoded as one byte each.  The decoder therefore looks at the
+ * following 8 bytes at a time, and when none of them has the continuation
+ * bit set, adds all 8 deltas without examining the bytes one by one.
  */
 
 /*
@@ -289,26 +296,24 @@ ginPostingListDecodeAllSegments(GinPostingList *segment, int len, int *ndecoded_
 	int			nallocated;
 	uint64		val;
 	char	   *endseg = ((char *) segment) + len;
+	GinPostingList *seg;
 	int			ndecoded;
 	unsigned char *ptr;
 	unsigned char *endptr;
 
 	/*
-	 * Guess an initial size of the array.
+	 * Every encoded delta takes at least one byte, so a segment holds at most
+	 * nbytes + 1 items.  Size the result array for that up front, so that the
+	 * decoding loop below needn't check for overflow as it goes.
 	 */
-	nallocated = segment->nbytes * 2 + 1;
-	result = palloc(nallocated * sizeof(ItemPointerData));
+	nallocated = 0;
+	for (seg = segment; (char *) seg < endseg; seg = GinNextPostingListSegment(seg))
+		nallocated += seg->nbytes + 1;
+	result = palloc(Max(nallocated, 1) * sizeof(ItemPointerData));
 
 	ndecoded = 0;
 	while ((char *) segment < endseg)
 	{
-		/* enlarge output array if needed */
-		if (ndecoded >= nallocated)
-		{
-			nallocated *= 2;
-			result = repalloc(result, nallocated * sizeof(ItemPointerData));
-		}
-
 		/* copy the first item */
 		Assert(OffsetNumberIsValid(ItemPointerGetOffsetNumber(&segment->first)));
 		Assert(ndecoded == 0 || ginCompareItemPointers(&segment->first, &result[ndecoded - 1]) > 0);
@@ -320,11 +325,25 @@ ginPostingListDecodeAllSegments(GinPostingList *segment, int len, int *ndecoded_
 		endptr = segment->bytes + segment->nbytes;
 		while (ptr < endptr)
 		{
-			/* enlarge output array if needed */
-			if (ndecoded >= nallocated)
+			/* fast path for a run of 8 single-byte deltas */
+			if (endptr - ptr >= 8)
 			{
-				nallocated *= 2;
-				result = repalloc(result, nallocated * sizeof(ItemPointerData));
+				uint64		word;
+
+				memcpy(&word, ptr, sizeof(word));
+				if ((word & UINT64CONST(0x8080808080808080)) == 0)
+				{
+					int			i;
+
+					for (i = 0; i < 8; i++)
+					{
+						val += ptr[i];
+						uint64_to_itemptr(val, &result[ndecoded + i]);
+					}
+					ndecoded += 8;
+					ptr += 8;
+					continue;
+				}
 			}
 
 			val += decode_varbyte(&ptr);
@@ -334,6 +353,7 @@ ginPostingListDecodeAllSegments(GinPostingList *segment, int len, int *ndecoded_
 		}
 		segment = GinNextPostingListSegment(segment);
 	}
+	Assert(ndecoded <= nallocated);
 
 	if (ndecoded_out)
 		*ndecoded_out = ndecoded;
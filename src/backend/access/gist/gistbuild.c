@@ -26,6 +26,7 @@
 #include "storage/smgr.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
+#include "utils/tuplesort.h"
 
 /* Step of index tuples for check whether to switch to buffering build mode */
 #define BUFFERING_MODE_SWITCH_CHECK_STEP 256
@@ -51,6 +52,16 @@ typedef enum
 	GIST_BUFFERING_ACTIVE		/* in buffering build mode */
 } GistBufferingMode;
 
+/*
+ * In a sorted build, we keep the last page of each level of the tree in
+ * local memory, linked from the leaf level up.
+ */
+typedef struct GistSortedBuildPageState
+{
+	Page		page;
+	struct GistSortedBuildPageState *parent;	/* next level up, if any */
+} GistSortedBuildPageState;
+
 /* Working state for gistbuild and its callback */
 typedef struct
 {
@@ -71,6 +82,15 @@ typedef struct
 	HTAB	   *parentMap;
 
 	GistBufferingMode bufferingMode;
+
+	/*
+	 * Extra data used during a sorted build.  'sortstate' is NULL unless the
+	 * index is being built by sorting.
+	 */
+	Tuplesortstate *sortstate;
+	BlockNumber pages_allocated;	/* # of blocks handed out so far */
+	BlockNumber pages_written;	/* # of blocks written out so far */
+	Page		zeropage;		/* all-zeroes page for filling gaps */
 } GISTBuildState;
 
 /* prototypes for private functions */
@@ -104,10 +124,31 @@ static void gistMemorizeParent(GISTBuildState *buildstate, BlockNumber child,
 static void gistMemorizeAllDownlinks(GISTBuildState *buildstate, Buffer parent);
 static BlockNumber gistGetParent(GISTBuildState *buildstate, BlockNumber child);
 
+static bool gistCanSortBuild(Relation index);
+static void gistSortedBuildCallback(Relation index,
+						HeapTuple htup,
+						Datum *values,
+						bool *isnull,
+						bool tupleIsAlive,
+						void *state);
+static void gist_indexsortbuild(GISTBuildState *state);
+static void gist_indexsortbuild_pagestate_add(GISTBuildState *state,
+								  GistSortedBuildPageState *pagestate,
+								  IndexTuple itup);
+static void gist_indexsortbuild_pagestate_flush(GISTBuildState *state,
+									GistSortedBuildPageState *pagestate);
+static void gist_indexsortbuild_writepage(GISTBuildState *state, Page page,
+							  BlockNumber blkno);
+
 /*
- * Main entry point to GiST index build. Initially calls insert over and over,
- * but switches to more efficient buffering build algorithm after a certain
- * number of tuples (unless buffering mode is disabled).
+ * Main entry point to GiST index build.
+ *
+ * If every key column's opclass provides a sortsupport method, and buffering
+ * isn't explicitly requested, the index is built by sorting all the tuples
+ * and packing them into pages bottom-up, see gist_indexsortbuild().
+ * Otherwise we initially call insert over and over, but switch to the more
+ * efficient buffering build algorithm after a certain number of tuples
+ * (unless buffering mode is disabled).
  */
 Datum
 gistbuild(PG_FUNCTION_ARGS)
@@ -169,53 +210,78 @@ gistbuild(PG_FUNCTION_ARGS)
 	 */
 	buildstate.giststate->tempCxt = createTempGistContext();
 
-	/* initialize the root page */
-	buffer = gistNewBuffer(index);
-	Assert(BufferGetBlockNumber(buffer) == GIST_ROOT_BLKNO);
-	page = BufferGetPage(buffer);
-
-	START_CRIT_SECTION();
+	buildstate.indtuples = 0;
+	buildstate.indtuplesSize = 0;
+	buildstate.sortstate = NULL;
 
-	GISTInitBuffer(buffer, F_LEAF);
+	if (buildstate.bufferingMode != GIST_BUFFERING_STATS &&
+		gistCanSortBuild(index))
+	{
+		/*
+		 * Sort all the tuples, then write out the index bottom-up.  The root
+		 * page is written last, so there's nothing to initialize first.
+		 */
+		buildstate.sortstate = tuplesort_begin_index_gist(heap, index,
+														  maintenance_work_mem,
+														  false);
 
-	MarkBufferDirty(buffer);
+		reltuples = IndexBuildHeapScan(heap, index, indexInfo, true,
+									   gistSortedBuildCallback,
+									   (void *) &buildstate);
 
-	if (RelationNeedsWAL(index))
-	{
-		XLogRecPtr	recptr;
+		tuplesort_performsort(buildstate.sortstate);
 
-		XLogBeginInsert();
-		XLogRegisterBuffer(0, buffer, REGBUF_WILL_INIT);
+		gist_indexsortbuild(&buildstate);
 
-		recptr = XLogInsert(RM_GIST_ID, XLOG_GIST_CREATE_INDEX);
-		PageSetLSN(page, recptr);
+		tuplesort_end(buildstate.sortstate);
 	}
 	else
-		PageSetLSN(page, gistGetFakeLSN(heap));
+	{
+		/* initialize the root page */
+		buffer = gistNewBuffer(index);
+		Assert(BufferGetBlockNumber(buffer) == GIST_ROOT_BLKNO);
+		page = BufferGetPage(buffer);
 
-	UnlockReleaseBuffer(buffer);
+		START_CRIT_SECTION();
 
-	END_CRIT_SECTION();
+		GISTInitBuffer(buffer, F_LEAF);
 
-	/* build the index */
-	buildstate.indtuples = 0;
-	buildstate.indtuplesSize = 0;
+		MarkBufferDirty(buffer);
 
-	/*
-	 * Do the heap scan.
-	 */
-	reltuples = IndexBuildHeapScan(heap, index, indexInfo, true,
-								   gistBuildCallback, (void *) &buildstate);
+		if (RelationNeedsWAL(index))
+		{
+			XLogRecPtr	recptr;
 
-	/*
-	 * If buffering was used, flush out all the tuples that are still in the
-	 * buffers.
-	 */
-	if (buildstate.bufferingMode == GIST_BUFFERING_ACTIVE)
-	{
-		elog(DEBUG1, "all tuples processed, emptying buffers");
-		gistEmptyAllBuffers(&buildstate);
-		gistFreeBuildBuffers(buildstate.gfbb);
+			XLogBeginInsert();
+			XLogRegisterBuffer(0, buffer, REGBUF_WILL_INIT);
+
+			recptr = XLogInsert(RM_GIST_ID, XLOG_GIST_CREATE_INDEX);
+			PageSetLSN(page, recptr);
+		}
+		else
+			PageSetLSN(page, gistGetFakeLSN(heap));
+
+		UnlockReleaseBuffer(buffer);
+
+		END_CRIT_SECTION();
+
+		/*
+		 * Do the heap scan.
+		 */
+		reltuples = IndexBuildHeapScan(heap, index, indexInfo, true,
+									   gistBuildCallback,
+									   (void *) &buildstate);
+
+		/*
+		 * If buffering was used, flush out all the tuples that are still in
+		 * the buffers.
+		 */
+		if (buildstate.bufferingMode == GIST_BUFFERING_ACTIVE)
+		{
+			elog(DEBUG1, "all tuples processed, emptying buffers");
+			gistEmptyAllBuffers(&buildstate);
+			gistFreeBuildBuffers(buildstate.gfbb);
+		}
 	}
 
 	/* okay, all heap tuples are indexed */
@@ -1201,3 +1267,266 @@ gistGetParent(GISTBuildState *buildstate, BlockNumber child)
 
 	return entry->parentblkno;
 }
+
+/*
+ * Routines for the sorted build.
+ *
+ * The heap tuples are compressed into leaf keys and put through a tuplesort
+ * in the order defined by the opclasses' sortsupport methods, which for
+ * spatial data is a space-filling curve.  The sorted tuples are then simply
+ * packed into leaf pages in order, each page being filled up to the
+ * fillfactor.  Whenever a page is full, it is written out, and a downlink
+ * carrying the union of its keys is added to the page we're filling on the
+ * next level up, which in turn is written out when it fills up, and so on.
+ * Because neighbouring keys in the sort order are usually close to each
+ * other in space, the resulting pages have small bounding boxes, and the
+ * build needs none of the page splits and penalty calculations of the
+ * insert-based build.
+ *
+ * Like nbtsort.c, we assemble pages in local memory and write them directly
+ * to disk, bypassing shared buffers.  Block 0 is reserved for the root,
+ * which is only written once everything below it is done.
+ */
+
+/*
+ * Can the index be built by sorting?  That requires a sortsupport method
+ * for every key column.
+ */
+static bool
+gistCanSortBuild(Relation index)
+{
+	int			i;
+
+	for (i = 0; i < IndexRelationGetNumberOfKeyAttributes(index); i++)
+	{
+		if (!OidIsValid(index_getprocid(index, i + 1, GIST_SORTSUPPORT_PROC)))
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Per-tuple callback from IndexBuildHeapScan, in a sorted build.
+ */
+static void
+gistSortedBuildCallback(Relation index,
+						HeapTuple htup,
+						Datum *values,
+						bool *isnull,
+						bool tupleIsAlive,
+						void *state)
+{
+	GISTBuildState *buildstate = (GISTBuildState *) state;
+	MemoryContext oldCtx;
+	Datum		compressed_values[INDEX_MAX_KEYS];
+
+	oldCtx = MemoryContextSwitchTo(buildstate->giststate->tempCxt);
+
+	/* the sort works on leaf keys, so compress the values first */
+	gistCompressValues(buildstate->giststate, index,
+					   values, isnull, true, compressed_values);
+
+	tuplesort_putindextuplevalues(buildstate->sortstate,
+								  buildstate->indexrel,
+								  &htup->t_self,
+								  compressed_values, isnull);
+
+	MemoryContextSwitchTo(oldCtx);
+	MemoryContextReset(buildstate->giststate->tempCxt);
+
+	/* Update tuple count. */
+	buildstate->indtuples += 1;
+}
+
+/*
+ * Build the index from the sorted tuples in state->sortstate.
+ */
+static void
+gist_indexsortbuild(GISTBuildState *state)
+{
+	GistSortedBuildPageState *leafstate;
+	GistSortedBuildPageState *pagestate;
+	IndexTuple	itup;
+	bool		should_free;
+
+	/* block 0 is reserved for the root */
+	state->pages_allocated = GIST_ROOT_BLKNO + 1;
+	state->pages_written = 0;
+	state->zeropage = NULL;
+
+	leafstate = (GistSortedBuildPageState *)
+		palloc(sizeof(GistSortedBuildPageState));
+	leafstate->page = (Page) palloc(BLCKSZ);
+	leafstate->parent = NULL;
+	GISTInitPage(leafstate->page, F_LEAF, BLCKSZ);
+
+	while ((itup = tuplesort_getindextuple(state->sortstate, true,
+										   &should_free)) != NULL)
+	{
+		gist_indexsortbuild_pagestate_add(state, leafstate, itup);
+		if (should_free)
+			pfree(itup);
+		MemoryContextReset(state->giststate->tempCxt);
+	}
+
+	/*
+	 * Write out the partially full page on every level, adding its downlink
+	 * to the level above, until we reach the topmost level.  That one has a
+	 * single page, which becomes the root.  If all the tuples fit on one
+	 * leaf page (or there were none), the root is a leaf.
+	 */
+	pagestate = leafstate;
+	while (pagestate->parent != NULL)
+	{
+		GistSortedBuildPageState *parent;
+
+		gist_indexsortbuild_pagestate_flush(state, pagestate);
+		MemoryContextReset(state->giststate->tempCxt);
+
+		parent = pagestate->parent;
+		pfree(pagestate->page);
+		pfree(pagestate);
+		pagestate = parent;
+	}
+
+	gist_indexsortbuild_writepage(state, pagestate->page, GIST_ROOT_BLKNO);
+	pfree(pagestate->page);
+	pfree(pagestate);
+
+	if (state->zeropage)
+		pfree(state->zeropage);
+
+	/*
+	 * As in nbtsort.c, we have to fsync the index ourselves, since we wrote
+	 * it outside shared buffers; a checkpoint during the build wouldn't have
+	 * known to flush it.
+	 */
+	if (RelationNeedsWAL(state->indexrel))
+	{
+		RelationOpenSmgr(state->indexrel);
+		smgrimmedsync(state->indexrel->rd_smgr, MAIN_FORKNUM);
+	}
+}
+
+/*
+ * Add a tuple to the page being filled on a level, writing out the page
+ * first if the tuple won't fit on it.
+ */
+static void
+gist_indexsortbuild_pagestate_add(GISTBuildState *state,
+								  GistSortedBuildPageState *pagestate,
+								  IndexTuple itup)
+{
+	if (!gistfitpage(&itup, 1))
+		ereport(ERROR,
+				(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+			errmsg("index row size %zu exceeds maximum %zu for index \"%s\"",
+				   IndexTupleSize(itup), GiSTPageSize,
+				   RelationGetRelationName(state->indexrel))));
+
+	/* leave the fillfactor's worth of free space, but never an empty page */
+	if (PageGetMaxOffsetNumber(pagestate->page) >= FirstOffsetNumber &&
+		PageGetFreeSpace(pagestate->page) <
+		IndexTupleSize(itup) + state->freespace)
+		gist_indexsortbuild_pagestate_flush(state, pagestate);
+
+	gistfillbuffer(pagestate->page, &itup, 1, InvalidOffsetNumber);
+}
+
+/*
+ * Write out the page being filled on a level, add its downlink to the level
+ * above (creating that level if this was the top one so far), and start a
+ * new, empty page on this level.
+ */
+static void
+gist_indexsortbuild_pagestate_flush(GISTBuildState *state,
+									GistSortedBuildPageState *pagestate)
+{
+	GistSortedBuildPageState *parent;
+	IndexTuple *itvec;
+	IndexTuple	downlink;
+	int			vect_len;
+	BlockNumber blkno;
+	bool		isleaf;
+	MemoryContext oldCtx;
+
+	CHECK_FOR_INTERRUPTS();
+
+	/* compute the downlink; it's in tempCxt, which the caller resets */
+	oldCtx = MemoryContextSwitchTo(state->giststate->tempCxt);
+	itvec = gistextractpage(pagestate->page, &vect_len);
+	downlink = gistunion(state->indexrel, itvec, vect_len, state->giststate);
+	MemoryContextSwitchTo(oldCtx);
+
+	blkno = state->pages_allocated++;
+	ItemPointerSetBlockNumber(&(downlink->t_tid), blkno);
+
+	isleaf = GistPageIsLeaf(pagestate->page);
+	gist_indexsortbuild_writepage(state, pagestate->page, blkno);
+	GISTInitPage(pagestate->page, isleaf ? F_LEAF : 0, BLCKSZ);
+
+	parent = pagestate->parent;
+	if (parent == NULL)
+	{
+		parent = (GistSortedBuildPageState *)
+			palloc(sizeof(GistSortedBuildPageState));
+		parent->page = (Page) palloc(BLCKSZ);
+		parent->parent = NULL;
+		GISTInitPage(parent->page, 0, BLCKSZ);
+		pagestate->parent = parent;
+	}
+
+	gist_indexsortbuild_pagestate_add(state, parent, downlink);
+}
+
+/*
+ * Write a finished page to disk, WAL-logging it if needed.  The page buffer
+ * is not released; the caller can reuse it.
+ *
+ * This is closely modeled on _bt_blwritepage().
+ */
+static void
+gist_indexsortbuild_writepage(GISTBuildState *state, Page page,
+							  BlockNumber blkno)
+{
+	Relation	index = state->indexrel;
+
+	/* Ensure rd_smgr is open (could have been closed by relcache flush!) */
+	RelationOpenSmgr(index);
+
+	if (RelationNeedsWAL(index))
+		log_newpage(&index->rd_node, MAIN_FORKNUM, blkno, page, true);
+	else
+		PageSetLSN(page, gistGetFakeLSN(index));
+
+	/*
+	 * The root is written last, so block 0 and possibly others have to be
+	 * filled with zeroes until we come back and overwrite them.
+	 */
+	while (blkno > state->pages_written)
+	{
+		if (!state->zeropage)
+			state->zeropage = (Page) palloc0(BLCKSZ);
+		/* don't set checksum for all-zero page */
+		smgrextend(index->rd_smgr, MAIN_FORKNUM, state->pages_written++,
+				   (char *) state->zeropage, true);
+	}
+
+	PageSetChecksumInplace(page, blkno);
+
+	/*
+	 * There's no need for smgr to schedule an fsync for this write; we'll do
+	 * it ourselves before ending the build.
+	 */
+	if (blkno == state->pages_written)
+	{
+		/* extending the file... */
+		smgrextend(index->rd_smgr, MAIN_FORKNUM, blkno, (char *) page, true);
+		state->pages_written++;
+	}
+	else
+	{
+		/* overwriting a block we zero-filled before */
+		smgrwrite(index->rd_smgr, MAIN_FORKNUM, blkno, (char *) page, true);
+	}
+}
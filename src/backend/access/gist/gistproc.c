@@ -17,9 +17,12 @@
  */
 #include "postgres.h"
 
+#include <math.h>
+
 #include "access/gist.h"
 #include "access/stratnum.h"
 #include "utils/geo_decls.h"
+#include "utils/sortsupport.h"
 
 
 static bool gist_box_leaf_consistent(BOX *key, BOX *query,
@@ -1222,6 +1225,120 @@ gist_point_fetch(PG_FUNCTION_ARGS)
 	PG_RETURN_POINTER(retval);
 }
 
+/*
+ * Map a float to an unsigned integer of the same width that sorts the same
+ * way, so that it can be bit-interleaved with another one.  NaNs go last.
+ */
+static uint32
+point_float_to_uint32(double d)
+{
+	union
+	{
+		float4		f;
+		uint32		i;
+	}			u;
+
+	if (isnan(d))
+		return PG_UINT32_MAX;
+
+	u.f = (float4) d;
+	if (u.i & 0x80000000)
+		return ~u.i;			/* negative: reverse the order */
+	else
+		return u.i | 0x80000000;
+}
+
+/* spread the 32 bits of x out over the even bits of the result */
+static uint64
+point_spread_bits(uint32 x)
+{
+	uint64		v = x;
+
+	v = (v | (v << 16)) & UINT64CONST(0x0000FFFF0000FFFF);
+	v = (v | (v << 8)) & UINT64CONST(0x00FF00FF00FF00FF);
+	v = (v | (v << 4)) & UINT64CONST(0x0F0F0F0F0F0F0F0F);
+	v = (v | (v << 2)) & UINT64CONST(0x3333333333333333);
+	v = (v | (v << 1)) & UINT64CONST(0x5555555555555555);
+	return v;
+}
+
+/*
+ * Position of the centre of a leaf key along the Z-order (Morton) curve.
+ *
+ * The coordinates are first rounded to float4, which is more than enough
+ * resolution to cluster nearby points onto the same index page.
+ */
+static uint64
+point_zorder(BOX *box)
+{
+	uint32		ix = point_float_to_uint32((box->low.x + box->high.x) / 2.0);
+	uint32		iy = point_float_to_uint32((box->low.y + box->high.y) / 2.0);
+
+	return point_spread_bits(ix) | (point_spread_bits(iy) << 1);
+}
+
+static int
+gist_point_zorder_cmp(Datum a, Datum b, SortSupport ssup)
+{
+	uint64		za = point_zorder(DatumGetBoxP(a));
+	uint64		zb = point_zorder(DatumGetBoxP(b));
+
+	if (za == zb)
+		return 0;
+	return (za < zb) ? -1 : 1;
+}
+
+#if SIZEOF_DATUM >= 8
+static Datum
+gist_point_zorder_abbrev_convert(Datum original, SortSupport ssup)
+{
+	return (Datum) point_zorder(DatumGetBoxP(original));
+}
+
+static int
+gist_point_zorder_cmp_abbrev(Datum a, Datum b, SortSupport ssup)
+{
+	if (a == b)
+		return 0;
+	return (a < b) ? -1 : 1;
+}
+
+static bool
+gist_point_zorder_abbrev_abort(int memtupcount, SortSupport ssup)
+{
+	/* the abbreviated key is the whole sort key, so never give up on it */
+	return false;
+}
+#endif
+
+/*
+ * GiST sortsupport method for point
+ *
+ * Used by the sorted index build, which orders leaf keys (bounding boxes,
+ * see gist_point_compress) along a space-filling curve so that points close
+ * to each other end up on the same leaf page.  Where a Datum is wide enough
+ * to hold the whole Z-order value, it is used as the abbreviated key and the
+ * comparator never has to look at the boxes at all.
+ */
+Datum
+gist_point_sortsupport(PG_FUNCTION_ARGS)
+{
+	SortSupport ssup = (SortSupport) PG_GETARG_POINTER(0);
+
+	ssup->comparator = gist_point_zorder_cmp;
+#if SIZEOF_DATUM >= 8
+	if (ssup->abbreviate)
+	{
+		ssup->abbrev_converter = gist_point_zorder_abbrev_convert;
+		ssup->abbrev_abort = gist_point_zorder_abbrev_abort;
+		ssup->abbrev_full_comparator = gist_point_zorder_cmp;
+		ssup->comparator = gist_point_zorder_cmp_abbrev;
+	}
+#endif
+
+	PG_RETURN_VOID();
+}
+
 
 #define point_point_distance(p1,p2) \
 	DatumGetFloat8(DirectFunctionCall2(point_distance, \
@@ -20,8 +20,10 @@
 
 #include "access/hash.h"
 #include "access/relscan.h"
+#include "access/xloginsert.h"
 #include "catalog/index.h"
 #include "commands/vacuum.h"
+#include "miscadmin.h"
 #include "optimizer/cost.h"
 #include "optimizer/plancat.h"
 #include "storage/bufmgr.h"
@@ -386,6 +388,7 @@ hashbeginscan(PG_FUNCTION_ARGS)
 	so = (HashScanOpaque) palloc(sizeof(HashScanOpaqueData));
 	so->hashso_bucket_valid = false;
 	so->hashso_bucket_blkno = 0;
+	so->hashso_bucket_buf = InvalidBuffer;
 	so->hashso_curbuf = InvalidBuffer;
 	/* set position invalid (this will cause _hash_first call) */
 	ItemPointerSetInvalid(&(so->hashso_curpos));
@@ -421,6 +424,9 @@ hashrescan(PG_FUNCTION_ARGS)
 	if (so->hashso_bucket_blkno)
 		_hash_droplock(rel, so->hashso_bucket_blkno, HASH_SHARE);
 	so->hashso_bucket_blkno = 0;
+	if (BufferIsValid(so->hashso_bucket_buf))
+		_hash_dropbuf(rel, so->hashso_bucket_buf);
+	so->hashso_bucket_buf = InvalidBuffer;
 
 	/* set position invalid (this will cause _hash_first call) */
 	ItemPointerSetInvalid(&(so->hashso_curpos));
@@ -460,6 +466,9 @@ hashendscan(PG_FUNCTION_ARGS)
 	if (so->hashso_bucket_blkno)
 		_hash_droplock(rel, so->hashso_bucket_blkno, HASH_SHARE);
 	so->hashso_bucket_blkno = 0;
+	if (BufferIsValid(so->hashso_bucket_buf))
+		_hash_dropbuf(rel, so->hashso_bucket_buf);
+	so->hashso_bucket_buf = InvalidBuffer;
 
 	pfree(so);
 	scan->opaque = NULL;
@@ -515,6 +524,17 @@ hashbulkdelete(PG_FUNCTION_ARGS)
 	tuples_removed = 0;
 	num_index_tuples = 0;
 
+	/*
+	 * Finish any bucket split that's in progress, as far as we can without
+	 * waiting, so that the space taken by the copied tuples in the old bucket
+	 * is reclaimed even if insertions have stopped.
+	 */
+	metabuf = _hash_getbuf(rel, HASH_METAPAGE, HASH_READ, LH_META_PAGE);
+	_hash_chgbufaccess(rel, metabuf, HASH_READ, HASH_NOLOCK);
+	while (_hash_split_step(rel, metabuf))
+		vacuum_delay_point();
+	_hash_chgbufaccess(rel, metabuf, HASH_NOLOCK, HASH_READ);
+
 	/*
 	 * Read the metapage to fetch original bucket and tuple counts.  Also, we
 	 * keep a copy of the last-seen metapage so that we can use its
@@ -523,7 +543,6 @@ hashbulkdelete(PG_FUNCTION_ARGS)
 	 * array cannot change under us; and it beats rereading the metapage for
 	 * each bucket.
 	 */
-	metabuf = _hash_getbuf(rel, HASH_METAPAGE, HASH_READ, LH_META_PAGE);
 	metap = HashPageGetMeta(BufferGetPage(metabuf));
 	orig_maxbucket = metap->hashm_maxbucket;
 	orig_ntuples = metap->hashm_ntuples;
@@ -539,6 +558,7 @@ loop_top:
 	{
 		BlockNumber bucket_blkno;
 		BlockNumber blkno;
+		Buffer		bucket_buf = InvalidBuffer;
 		bool		bucket_dirty = false;
 
 		/* Get address of bucket's start page */
@@ -572,6 +592,13 @@ loop_top:
 			opaque = (HashPageOpaque) PageGetSpecialPointer(page);
 			Assert(opaque->hasho_bucket == cur_bucket);
 
+			/*
+			 * Keep the primary bucket page pinned while we work on the rest
+			 * of the bucket, see _hash_delete_items().
+			 */
+			if (blkno == bucket_blkno)
+				bucket_buf = buf;
+
 			/* Scan each tuple in page */
 			maxoffno = PageGetMaxOffsetNumber(page);
 			for (offno = FirstOffsetNumber;
@@ -588,10 +615,17 @@ loop_top:
 				{
 					/* mark the item for deletion */
 					deletable[ndeletable++] = offno;
-					tuples_removed += 1;
+					if (!HashTupleIsCopied(itup))
+						tuples_removed += 1;
 				}
-				else
+				else if (!HashTupleIsCopied(itup))
+				{
+					/*
+					 * Tuples already copied to the new bucket of a split in
+					 * progress are counted there instead.
+					 */
 					num_index_tuples += 1;
+				}
 			}
 
 			/*
@@ -601,14 +635,19 @@ loop_top:
 
 			if (ndeletable > 0)
 			{
-				PageIndexMultiDelete(page, deletable, ndeletable);
-				_hash_wrtbuf(rel, buf);
+				_hash_delete_items(rel, bucket_buf, buf,
+								   deletable, ndeletable);
 				bucket_dirty = true;
 			}
+
+			if (buf == bucket_buf)
+				_hash_chgbufaccess(rel, buf, HASH_READ, HASH_NOLOCK);
 			else
 				_hash_relbuf(rel, buf);
 		}
 
+		_hash_dropbuf(rel, bucket_buf);
+
 		/* If we deleted anything, try to compact free space */
 		if (bucket_dirty)
 			_hash_squeezebucket(rel, cur_bucket, bucket_blkno,
@@ -635,6 +674,7 @@ loop_top:
 	}
 
 	/* Okay, we're really done.  Update tuple count in metapage. */
+	START_CRIT_SECTION();
 
 	if (orig_maxbucket == metap->hashm_maxbucket &&
 		orig_ntuples == metap->hashm_ntuples)
@@ -660,7 +700,28 @@ loop_top:
 		num_index_tuples = metap->hashm_ntuples;
 	}
 
-	_hash_wrtbuf(rel, metabuf);
+	MarkBufferDirty(metabuf);
+
+	/* XLOG stuff */
+	if (RelationNeedsWAL(rel))
+	{
+		xl_hash_update_meta_page xlrec;
+		XLogRecPtr	recptr;
+
+		xlrec.ntuples = metap->hashm_ntuples;
+
+		XLogBeginInsert();
+		XLogRegisterData((char *) &xlrec, SizeOfHashUpdateMetaPage);
+		XLogRegisterBuffer(0, metabuf, 0);
+
+		recptr = XLogInsert(RM_HASH_ID, XLOG_HASH_UPDATE_META_PAGE);
+
+		PageSetLSN(BufferGetPage(metabuf), recptr);
+	}
+
+	END_CRIT_SECTION();
+
+	_hash_relbuf(rel, metabuf);
 
 	/* return statistics */
 	if (stats == NULL)
@@ -698,9 +759,3 @@ hashvacuumcleanup(PG_FUNCTION_ARGS)
 	PG_RETURN_POINTER(stats);
 }
 
-
-void
-hash_redo(XLogReaderState *record)
-{
-	elog(PANIC, "hash_redo: unimplemented");
-}
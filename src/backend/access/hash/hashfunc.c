@@ -188,6 +188,41 @@ hashvarlena(PG_FUNCTION_ARGS)
 	return result;
 }
 
+/*
+ * hashtext_fast() and hashvarlena_fast() are the same as hashtext() and
+ * hashvarlena(), except that they use hash_any_fast().  They are not in
+ * pg_proc; see execHashFunctionInfo().
+ */
+Datum
+hashtext_fast(PG_FUNCTION_ARGS)
+{
+	text	   *key = PG_GETARG_TEXT_PP(0);
+	Datum		result;
+
+	result = hash_any_fast((unsigned char *) VARDATA_ANY(key),
+						   VARSIZE_ANY_EXHDR(key));
+
+	/* Avoid leaking memory for toasted inputs */
+	PG_FREE_IF_COPY(key, 0);
+
+	return result;
+}
+
+Datum
+hashvarlena_fast(PG_FUNCTION_ARGS)
+{
+	struct varlena *key = PG_GETARG_VARLENA_PP(0);
+	Datum		result;
+
+	result = hash_any_fast((unsigned char *) VARDATA_ANY(key),
+						   VARSIZE_ANY_EXHDR(key));
+
+	/* Avoid leaking memory for toasted inputs */
+	PG_FREE_IF_COPY(key, 0);
+
+	return result;
+}
+
 /*
  * This hash function was written by Bob Jenkins
  * (bob_jenkins@burtleburtle.net), and superficially adapted
@@ -521,3 +556,56 @@ hash_uint32(uint32 k)
 	/* report the result */
 	return UInt32GetDatum(c);
 }
+
+/*
+ * hash_any_fast() -- hash a variable-length key into a 32-bit value
+ *		k		: the key (the unaligned variable-length array of bytes)
+ *		len		: the length of the key, counting by bytes
+ *
+ * This is Austin Appleby's MurmurHash64A, which digests 8 bytes at a time
+ * with two multiplications, where hash_any() needs a dozen or so operations
+ * per 4 bytes.  Its result depends on the byte order of the machine, and we
+ * reserve the right to change it in any release, so unlike hash_any() it
+ * must never be used for anything stored on disk, such as hash indexes.
+ * The key is read with memcpy(), which compilers turn into plain loads on
+ * platforms that allow unaligned access.
+ */
+Datum
+hash_any_fast(const unsigned char *k, int keylen)
+{
+	const uint64 m = UINT64CONST(0xc6a4a7935bd1e995);
+	const int	r = 47;
+	uint64		h;
+	uint64		v;
+
+	h = UINT64CONST(0x9e3779b97f4a7c15) ^ ((uint64) keylen * m);
+
+	while (keylen >= (int) sizeof(uint64))
+	{
+		memcpy(&v, k, sizeof(uint64));
+		v *= m;
+		v ^= v >> r;
+		v *= m;
+		h ^= v;
+		h *= m;
+
+		k += sizeof(uint64);
+		keylen -= sizeof(uint64);
+	}
+
+	/* handle the last 0 to 7 bytes */
+	if (keylen > 0)
+	{
+		v = 0;
+		memcpy(&v, k, keylen);
+		h ^= v;
+		h *= m;
+	}
+
+	h ^= h >> r;
+	h *= m;
+	h ^= h >> r;
+
+	/* report the result, folding in the high half */
+	return UInt32GetDatum((uint32) (h ^ (h >> 32)));
+}
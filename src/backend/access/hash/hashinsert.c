@@ -16,6 +16,8 @@
 #include "postgres.h"
 
 #include "access/hash.h"
+#include "access/xloginsert.h"
+#include "miscadmin.h"
 #include "utils/rel.h"
 
 
@@ -37,6 +39,8 @@ _hash_doinsert(Relation rel, IndexTuple itup)
 	Page		page;
 	HashPageOpaque pageopaque;
 	Size		itemsz;
+	OffsetNumber itup_off;
+	bool		split_pending;
 	bool		do_expand;
 	uint32		hashkey;
 	Bucket		bucket;
@@ -77,10 +81,7 @@ _hash_doinsert(Relation rel, IndexTuple itup)
 		/*
 		 * Compute the target bucket number, and convert to block number.
 		 */
-		bucket = _hash_hashkey2bucket(hashkey,
-									  metap->hashm_maxbucket,
-									  metap->hashm_highmask,
-									  metap->hashm_lowmask);
+		bucket = _hash_getbucket(metap, hashkey);
 
 		blkno = BUCKET_TO_BLKNO(metap, bucket);
 
@@ -137,13 +138,10 @@ _hash_doinsert(Relation rel, IndexTuple itup)
 		{
 			/*
 			 * we're at the end of the bucket chain and we haven't found a
-			 * page with enough room.  allocate a new overflow page.
+			 * page with enough room.  allocate a new overflow page, keeping
+			 * our write lock on the tail page so that the new page is linked
+			 * directly after it.
 			 */
-
-			/* release our write lock without modifying buffer */
-			_hash_chgbufaccess(rel, buf, HASH_READ, HASH_NOLOCK);
-
-			/* chain to a new overflow page */
 			buf = _hash_addovflpage(rel, metabuf, buf);
 			page = BufferGetPage(buf);
 
@@ -155,32 +153,70 @@ _hash_doinsert(Relation rel, IndexTuple itup)
 		Assert(pageopaque->hasho_bucket == bucket);
 	}
 
-	/* found page with enough space, so add the item here */
-	(void) _hash_pgaddtup(rel, buf, itemsz, itup);
-
-	/* write and release the modified page */
-	_hash_wrtbuf(rel, buf);
-
-	/* We can drop the bucket lock now */
-	_hash_droplock(rel, blkno, HASH_SHARE);
-
 	/*
-	 * Write-lock the metapage so we can increment the tuple count. After
-	 * incrementing it, check to see if it's time for a split.
+	 * Found page with enough space.  Write-lock the metapage too, so that
+	 * adding the item and incrementing the tuple count can go into a single
+	 * WAL record.  Holding the metapage lock while we do this is okay: data
+	 * pages are always locked before the metapage (see README).
 	 */
 	_hash_chgbufaccess(rel, metabuf, HASH_NOLOCK, HASH_WRITE);
 
+	/* No ereport(ERROR) until changes are logged */
+	START_CRIT_SECTION();
+
+	itup_off = _hash_pgaddtup(rel, buf, itemsz, itup);
+	MarkBufferDirty(buf);
+
 	metap->hashm_ntuples += 1;
+	MarkBufferDirty(metabuf);
+
+	/* XLOG stuff */
+	if (RelationNeedsWAL(rel))
+	{
+		xl_hash_insert xlrec;
+		XLogRecPtr	recptr;
+
+		xlrec.offnum = itup_off;
+
+		XLogBeginInsert();
+		XLogRegisterData((char *) &xlrec, SizeOfHashInsert);
 
-	/* Make sure this stays in sync with _hash_expandtable() */
+		XLogRegisterBuffer(0, buf, REGBUF_STANDARD);
+		XLogRegisterBufData(0, (char *) itup, IndexTupleDSize(*itup));
+
+		XLogRegisterBuffer(1, metabuf, 0);
+
+		recptr = XLogInsert(RM_HASH_ID, XLOG_HASH_INSERT);
+
+		PageSetLSN(BufferGetPage(buf), recptr);
+		PageSetLSN(BufferGetPage(metabuf), recptr);
+	}
+
+	END_CRIT_SECTION();
+
+	/*
+	 * Check to see if it's time for a split, or if there is one in progress
+	 * that we should help along.  Make sure this stays in sync with
+	 * _hash_expandtable().
+	 */
+	split_pending = (metap->hashm_splitstate != HASH_SPLIT_NONE);
 	do_expand = metap->hashm_ntuples >
 		(double) metap->hashm_ffactor * (metap->hashm_maxbucket + 1);
 
-	/* Write out the metapage and drop lock, but keep pin */
-	_hash_chgbufaccess(rel, metabuf, HASH_WRITE, HASH_NOLOCK);
+	/* Drop metapage lock, but keep pin */
+	_hash_chgbufaccess(rel, metabuf, HASH_READ, HASH_NOLOCK);
+
+	/* release the modified page, and then the bucket lock */
+	_hash_relbuf(rel, buf);
+	_hash_droplock(rel, blkno, HASH_SHARE);
 
-	/* Attempt to split if a split is needed */
-	if (do_expand)
+	/*
+	 * Do a step of the split in progress, if any, else attempt to start one
+	 * if needed.
+	 */
+	if (split_pending)
+		(void) _hash_split_step(rel, metabuf);
+	else if (do_expand)
 		_hash_expandtable(rel, metabuf);
 
 	/* Finally drop our pin on the metapage */
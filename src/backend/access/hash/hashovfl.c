@@ -18,11 +18,16 @@
 #include "postgres.h"
 
 #include "access/hash.h"
+#include "access/xloginsert.h"
+#include "miscadmin.h"
 #include "utils/rel.h"
 
 
-static Buffer _hash_getovflpage(Relation rel, Buffer metabuf);
 static uint32 _hash_firstfreebit(uint32 map);
+static void _hash_movetuples(Relation rel, Buffer bucketbuf,
+				 Buffer wbuf, Buffer rbuf,
+				 IndexTuple *itups, uint16 nitups,
+				 OffsetNumber *deletable);
 
 
 /*
@@ -80,107 +85,55 @@ blkno_to_bitno(HashMetaPage metap, BlockNumber ovflblkno)
  *
  *	Add an overflow page to the bucket whose last page is pointed to by 'buf'.
  *
- *	On entry, the caller must hold a pin but no lock on 'buf'.  The pin is
- *	dropped before exiting (we assume the caller is not interested in 'buf'
- *	anymore).  The returned overflow page will be pinned and write-locked;
- *	it is guaranteed to be empty.
+ *	On entry, the caller must hold a pin and write lock on 'buf', which must
+ *	be the current tail of the bucket chain; holding the lock ensures it stays
+ *	so.  The lock and pin are released before exiting (we assume the caller
+ *	is not interested in 'buf' anymore).  The returned overflow page will be
+ *	pinned and write-locked; it is guaranteed to be empty.
  *
  *	The caller must hold a pin, but no lock, on the metapage buffer.
  *	That buffer is returned in the same state.
  *
  *	The caller must hold at least share lock on the bucket, to ensure that
- *	no one else tries to compact the bucket meanwhile.  This guarantees that
- *	'buf' won't stop being part of the bucket while it's unlocked.
+ *	no one else tries to compact the bucket meanwhile.
  *
- * NB: since this could be executed concurrently by multiple processes,
- * one should not assume that the returned overflow page will be the
- * immediate successor of the originally passed 'buf'.  Additional overflow
- * pages might have been added to the bucket chain in between.
+ *	Finding a free page, marking it used in the bitmap, updating the
+ *	metapage and linking the page into the chain are all covered by a single
+ *	WAL record, so that a crash can't leave a page marked in use but not
+ *	part of any bucket, or vice versa.  Since the record needs the bitmap
+ *	page and the metapage locked at the same time as the tail page, they are
+ *	locked in that order: data page, bitmap page, metapage (see README).
  */
 Buffer
 _hash_addovflpage(Relation rel, Buffer metabuf, Buffer buf)
 {
+	HashMetaPage metap;
 	Buffer		ovflbuf;
+	Buffer		mapbuf = InvalidBuffer;
+	Buffer		newmapbuf = InvalidBuffer;
 	Page		page;
 	Page		ovflpage;
 	HashPageOpaque pageopaque;
 	HashPageOpaque ovflopaque;
-
-	/* allocate and lock an empty overflow page */
-	ovflbuf = _hash_getovflpage(rel, metabuf);
-
-	/*
-	 * Write-lock the tail page.  It is okay to hold two buffer locks here
-	 * since there cannot be anyone else contending for access to ovflbuf.
-	 */
-	_hash_chgbufaccess(rel, buf, HASH_NOLOCK, HASH_WRITE);
-
-	/* probably redundant... */
-	_hash_checkpage(rel, buf, LH_BUCKET_PAGE | LH_OVERFLOW_PAGE);
-
-	/* loop to find current tail page, in case someone else inserted too */
-	for (;;)
-	{
-		BlockNumber nextblkno;
-
-		page = BufferGetPage(buf);
-		pageopaque = (HashPageOpaque) PageGetSpecialPointer(page);
-		nextblkno = pageopaque->hasho_nextblkno;
-
-		if (!BlockNumberIsValid(nextblkno))
-			break;
-
-		/* we assume we do not need to write the unmodified page */
-		_hash_relbuf(rel, buf);
-
-		buf = _hash_getbuf(rel, nextblkno, HASH_WRITE, LH_OVERFLOW_PAGE);
-	}
-
-	/* now that we have correct backlink, initialize new overflow page */
-	ovflpage = BufferGetPage(ovflbuf);
-	ovflopaque = (HashPageOpaque) PageGetSpecialPointer(ovflpage);
-	ovflopaque->hasho_prevblkno = BufferGetBlockNumber(buf);
-	ovflopaque->hasho_nextblkno = InvalidBlockNumber;
-	ovflopaque->hasho_bucket = pageopaque->hasho_bucket;
-	ovflopaque->hasho_flag = LH_OVERFLOW_PAGE;
-	ovflopaque->hasho_page_id = HASHO_PAGE_ID;
-
-	MarkBufferDirty(ovflbuf);
-
-	/* logically chain overflow page to previous page */
-	pageopaque->hasho_nextblkno = BufferGetBlockNumber(ovflbuf);
-	_hash_wrtbuf(rel, buf);
-
-	return ovflbuf;
-}
-
-/*
- *	_hash_getovflpage()
- *
- *	Find an available overflow page and return it.  The returned buffer
- *	is pinned and write-locked, and has had _hash_pageinit() applied,
- *	but it is caller's responsibility to fill the special space.
- *
- * The caller must hold a pin, but no lock, on the metapage buffer.
- * That buffer is left in the same state at exit.
- */
-static Buffer
-_hash_getovflpage(Relation rel, Buffer metabuf)
-{
-	HashMetaPage metap;
-	Buffer		mapbuf = 0;
-	Buffer		newbuf;
 	BlockNumber blkno;
 	uint32		orig_firstfree;
 	uint32		splitnum;
 	uint32	   *freep = NULL;
 	uint32		max_ovflpg;
 	uint32		bit;
+	uint32		bitmap_page_bit = 0;
 	uint32		first_page;
 	uint32		last_bit;
 	uint32		last_page;
 	uint32		i,
 				j;
+	bool		page_found = false;
+
+	/* probably redundant... */
+	_hash_checkpage(rel, buf, LH_BUCKET_PAGE | LH_OVERFLOW_PAGE);
+	page = BufferGetPage(buf);
+	pageopaque = (HashPageOpaque) PageGetSpecialPointer(page);
+	Assert(!BlockNumberIsValid(pageopaque->hasho_nextblkno));
 
 	/* Get exclusive lock on the meta page */
 	_hash_chgbufaccess(rel, metabuf, HASH_NOLOCK, HASH_WRITE);
@@ -230,11 +183,32 @@ _hash_getovflpage(Relation rel, Buffer metabuf)
 		for (; bit <= last_inpage; j++, bit += BITS_PER_MAP)
 		{
 			if (freep[j] != ALL_SET)
+			{
+				page_found = true;
+
+				/* Reacquire exclusive lock on the meta page */
+				_hash_chgbufaccess(rel, metabuf, HASH_NOLOCK, HASH_WRITE);
+
+				/* convert bit to bit number within page */
+				bit += _hash_firstfreebit(freep[j]);
+				bitmap_page_bit = bit;
+
+				/* convert bit to absolute bit number */
+				bit += (i << BMPG_SHIFT(metap));
+
+				/* Calculate address of the recycled overflow page */
+				blkno = bitno_to_blkno(metap, bit);
+
+				/* Fetch and init the recycled page */
+				ovflbuf = _hash_getinitbuf(rel, blkno);
+
 				goto found;
+			}
 		}
 
 		/* No free space here, try to advance to next map page */
 		_hash_relbuf(rel, mapbuf);
+		mapbuf = InvalidBuffer;
 		i++;
 		j = 0;					/* scan from start of next map page */
 		bit = 0;
@@ -257,9 +231,16 @@ _hash_getovflpage(Relation rel, Buffer metabuf)
 		 * marked "in use".  Subsequent pages do not exist yet, but it is
 		 * convenient to pre-mark them as "in use" too.
 		 */
+		if (metap->hashm_nmaps >= HASH_MAX_BITMAPS)
+			ereport(ERROR,
+					(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+					 errmsg("out of overflow pages in hash index \"%s\"",
+							RelationGetRelationName(rel))));
+
 		bit = metap->hashm_spares[splitnum];
-		_hash_initbitmap(rel, metap, bitno_to_blkno(metap, bit), MAIN_FORKNUM);
-		metap->hashm_spares[splitnum]++;
+		newmapbuf = _hash_getnewbuf(rel, bitno_to_blkno(metap, bit),
+									MAIN_FORKNUM);
+		bit++;
 	}
 	else
 	{
@@ -267,10 +248,10 @@ _hash_getovflpage(Relation rel, Buffer metabuf)
 		 * Nothing to do here; since the page will be past the last used page,
 		 * we know its bitmap bit was preinitialized to "in use".
 		 */
+		bit = metap->hashm_spares[splitnum];
 	}
 
 	/* Calculate address of the new overflow page */
-	bit = metap->hashm_spares[splitnum];
 	blkno = bitno_to_blkno(metap, bit);
 
 	/*
@@ -279,9 +260,36 @@ _hash_getovflpage(Relation rel, Buffer metabuf)
 	 * with metapage write lock held; would be better to use a lock that
 	 * doesn't block incoming searches.
 	 */
-	newbuf = _hash_getnewbuf(rel, blkno, MAIN_FORKNUM);
+	ovflbuf = _hash_getnewbuf(rel, blkno, MAIN_FORKNUM);
+
+found:
+
+	/* No ereport(ERROR) until changes are logged */
+	START_CRIT_SECTION();
+
+	if (page_found)
+	{
+		/* mark page "in use" in the bitmap */
+		Assert(BufferIsValid(mapbuf));
+		SETBIT(freep, bitmap_page_bit);
+		MarkBufferDirty(mapbuf);
+	}
+	else
+	{
+		if (BufferIsValid(newmapbuf))
+		{
+			_hash_initbitmapbuffer(newmapbuf, metap->hashm_bmsize);
+			MarkBufferDirty(newmapbuf);
+
+			/* add the new bitmap page to the metapage's list of bitmaps */
+			metap->hashm_mapp[metap->hashm_nmaps] = BufferGetBlockNumber(newmapbuf);
+			metap->hashm_nmaps++;
+			metap->hashm_spares[splitnum]++;
+		}
 
-	metap->hashm_spares[splitnum]++;
+		/* and count the new overflow page */
+		metap->hashm_spares[splitnum]++;
+	}
 
 	/*
 	 * Adjust hashm_firstfree to avoid redundant searches.  But don't risk
@@ -290,47 +298,63 @@ _hash_getovflpage(Relation rel, Buffer metabuf)
 	if (metap->hashm_firstfree == orig_firstfree)
 		metap->hashm_firstfree = bit + 1;
 
-	/* Write updated metapage and release lock, but not pin */
-	_hash_chgbufaccess(rel, metabuf, HASH_WRITE, HASH_NOLOCK);
+	MarkBufferDirty(metabuf);
 
-	return newbuf;
+	/* now that we have correct backlink, initialize new overflow page */
+	ovflpage = BufferGetPage(ovflbuf);
+	ovflopaque = (HashPageOpaque) PageGetSpecialPointer(ovflpage);
+	ovflopaque->hasho_prevblkno = BufferGetBlockNumber(buf);
+	ovflopaque->hasho_nextblkno = InvalidBlockNumber;
+	ovflopaque->hasho_bucket = pageopaque->hasho_bucket;
+	ovflopaque->hasho_flag = LH_OVERFLOW_PAGE;
+	ovflopaque->hasho_page_id = HASHO_PAGE_ID;
 
-found:
-	/* convert bit to bit number within page */
-	bit += _hash_firstfreebit(freep[j]);
+	MarkBufferDirty(ovflbuf);
 
-	/* mark page "in use" in the bitmap */
-	SETBIT(freep, bit);
-	_hash_wrtbuf(rel, mapbuf);
+	/* logically chain overflow page to previous page */
+	pageopaque->hasho_nextblkno = BufferGetBlockNumber(ovflbuf);
 
-	/* Reacquire exclusive lock on the meta page */
-	_hash_chgbufaccess(rel, metabuf, HASH_NOLOCK, HASH_WRITE);
+	MarkBufferDirty(buf);
 
-	/* convert bit to absolute bit number */
-	bit += (i << BMPG_SHIFT(metap));
+	/* XLOG stuff */
+	if (RelationNeedsWAL(rel))
+	{
+		XLogRecPtr	recptr;
+
+		XLogBeginInsert();
+
+		XLogRegisterBuffer(0, ovflbuf, REGBUF_FORCE_IMAGE | REGBUF_STANDARD);
+		XLogRegisterBuffer(1, buf, REGBUF_FORCE_IMAGE | REGBUF_STANDARD);
+		if (BufferIsValid(mapbuf))
+			XLogRegisterBuffer(2, mapbuf, REGBUF_FORCE_IMAGE);
+		if (BufferIsValid(newmapbuf))
+			XLogRegisterBuffer(3, newmapbuf, REGBUF_FORCE_IMAGE);
+		XLogRegisterBuffer(4, metabuf, REGBUF_FORCE_IMAGE);
+
+		recptr = XLogInsert(RM_HASH_ID, XLOG_HASH_ADD_OVFL_PAGE);
+
+		PageSetLSN(ovflpage, recptr);
+		PageSetLSN(page, recptr);
+		if (BufferIsValid(mapbuf))
+			PageSetLSN(BufferGetPage(mapbuf), recptr);
+		if (BufferIsValid(newmapbuf))
+			PageSetLSN(BufferGetPage(newmapbuf), recptr);
+		PageSetLSN(BufferGetPage(metabuf), recptr);
+	}
 
-	/* Calculate address of the recycled overflow page */
-	blkno = bitno_to_blkno(metap, bit);
+	END_CRIT_SECTION();
 
-	/*
-	 * Adjust hashm_firstfree to avoid redundant searches.  But don't risk
-	 * changing it if someone moved it while we were searching bitmap pages.
-	 */
-	if (metap->hashm_firstfree == orig_firstfree)
-	{
-		metap->hashm_firstfree = bit + 1;
+	if (BufferIsValid(mapbuf))
+		_hash_relbuf(rel, mapbuf);
+	if (BufferIsValid(newmapbuf))
+		_hash_relbuf(rel, newmapbuf);
 
-		/* Write updated metapage and release lock, but not pin */
-		_hash_chgbufaccess(rel, metabuf, HASH_WRITE, HASH_NOLOCK);
-	}
-	else
-	{
-		/* We didn't change the metapage, so no need to write */
-		_hash_chgbufaccess(rel, metabuf, HASH_READ, HASH_NOLOCK);
-	}
+	/* Release metapage lock, but not pin */
+	_hash_chgbufaccess(rel, metabuf, HASH_READ, HASH_NOLOCK);
 
-	/* Fetch, init, and return the recycled page */
-	return _hash_getinitbuf(rel, blkno);
+	_hash_relbuf(rel, buf);
+
+	return ovflbuf;
 }
 
 /*
@@ -363,6 +387,11 @@ _hash_firstfreebit(uint32 map)
  *	Remove this overflow page from its bucket's chain, and mark the page as
  *	free.  On entry, ovflbuf is write-locked; it is released before exiting.
  *
+ *	'bucketbuf' is the primary page of the bucket, which the caller must keep
+ *	pinned; it is logged with the removal so that replay can take a cleanup
+ *	lock on it (see README).  If it is also the freed page's predecessor,
+ *	the caller must not hold a lock on it.
+ *
  *	Since this function is invoked in VACUUM, we provide an access strategy
  *	parameter that controls fetches of the bucket pages.
  *
@@ -374,12 +403,14 @@ _hash_firstfreebit(uint32 map)
  *	on the bucket, too.
  */
 BlockNumber
-_hash_freeovflpage(Relation rel, Buffer ovflbuf,
+_hash_freeovflpage(Relation rel, Buffer bucketbuf, Buffer ovflbuf,
 				   BufferAccessStrategy bstrategy)
 {
 	HashMetaPage metap;
 	Buffer		metabuf;
 	Buffer		mapbuf;
+	Buffer		prevbuf;
+	Buffer		nextbuf = InvalidBuffer;
 	BlockNumber ovflblkno;
 	BlockNumber prevblkno;
 	BlockNumber blkno;
@@ -391,6 +422,7 @@ _hash_freeovflpage(Relation rel, Buffer ovflbuf,
 	uint32		ovflbitno;
 	int32		bitmappage,
 				bitmapbit;
+	bool		update_metap = false;
 	Bucket bucket PG_USED_FOR_ASSERTS_ONLY;
 
 	/* Get information from the doomed page */
@@ -402,48 +434,36 @@ _hash_freeovflpage(Relation rel, Buffer ovflbuf,
 	prevblkno = ovflopaque->hasho_prevblkno;
 	bucket = ovflopaque->hasho_bucket;
 
-	/*
-	 * Zero the page for debugging's sake; then write and release it. (Note:
-	 * if we failed to zero the page here, we'd have problems with the Assert
-	 * in _hash_pageinit() when the page is reused.)
-	 */
-	MemSet(ovflpage, 0, BufferGetPageSize(ovflbuf));
-	_hash_wrtbuf(rel, ovflbuf);
+	/* an overflow page always has a predecessor */
+	Assert(BlockNumberIsValid(prevblkno));
+
+	/* the WAL record can reference more than the usual number of blocks */
+	if (RelationNeedsWAL(rel))
+		XLogEnsureRecordSpace(5, 0);
 
 	/*
-	 * Fix up the bucket chain.  this is a doubly-linked list, so we must fix
-	 * up the bucket chain members behind and ahead of the overflow page being
-	 * deleted.  No concurrency issues since we hold exclusive lock on the
+	 * Lock the bucket chain members behind and ahead of the overflow page
+	 * being deleted, so that the chain can be fixed up together with freeing
+	 * the page.  No concurrency issues since we hold exclusive lock on the
 	 * entire bucket.
 	 */
-	if (BlockNumberIsValid(prevblkno))
+	if (prevblkno == BufferGetBlockNumber(bucketbuf))
 	{
-		Buffer		prevbuf = _hash_getbuf_with_strategy(rel,
-														 prevblkno,
-														 HASH_WRITE,
-										   LH_BUCKET_PAGE | LH_OVERFLOW_PAGE,
-														 bstrategy);
-		Page		prevpage = BufferGetPage(prevbuf);
-		HashPageOpaque prevopaque = (HashPageOpaque) PageGetSpecialPointer(prevpage);
-
-		Assert(prevopaque->hasho_bucket == bucket);
-		prevopaque->hasho_nextblkno = nextblkno;
-		_hash_wrtbuf(rel, prevbuf);
+		prevbuf = bucketbuf;
+		LockBuffer(prevbuf, BUFFER_LOCK_EXCLUSIVE);
 	}
+	else
+		prevbuf = _hash_getbuf_with_strategy(rel,
+											 prevblkno,
+											 HASH_WRITE,
+											 LH_OVERFLOW_PAGE,
+											 bstrategy);
 	if (BlockNumberIsValid(nextblkno))
-	{
-		Buffer		nextbuf = _hash_getbuf_with_strategy(rel,
-														 nextblkno,
-														 HASH_WRITE,
-														 LH_OVERFLOW_PAGE,
-														 bstrategy);
-		Page		nextpage = BufferGetPage(nextbuf);
-		HashPageOpaque nextopaque = (HashPageOpaque) PageGetSpecialPointer(nextpage);
-
-		Assert(nextopaque->hasho_bucket == bucket);
-		nextopaque->hasho_prevblkno = prevblkno;
-		_hash_wrtbuf(rel, nextbuf);
-	}
+		nextbuf = _hash_getbuf_with_strategy(rel,
+											 nextblkno,
+											 HASH_WRITE,
+											 LH_OVERFLOW_PAGE,
+											 bstrategy);
 
 	/* Note: bstrategy is intentionally not used for metapage and bitmap */
 
@@ -464,63 +484,134 @@ _hash_freeovflpage(Relation rel, Buffer ovflbuf,
 	/* Release metapage lock while we access the bitmap page */
 	_hash_chgbufaccess(rel, metabuf, HASH_READ, HASH_NOLOCK);
 
-	/* Clear the bitmap bit to indicate that this overflow page is free */
 	mapbuf = _hash_getbuf(rel, blkno, HASH_WRITE, LH_BITMAP_PAGE);
 	mappage = BufferGetPage(mapbuf);
 	freep = HashPageGetBitmap(mappage);
 	Assert(ISSET(freep, bitmapbit));
-	CLRBIT(freep, bitmapbit);
-	_hash_wrtbuf(rel, mapbuf);
 
 	/* Get write-lock on metapage to update firstfree */
 	_hash_chgbufaccess(rel, metabuf, HASH_NOLOCK, HASH_WRITE);
 
+	/* No ereport(ERROR) until changes are logged */
+	START_CRIT_SECTION();
+
+	/*
+	 * Reinitialize the freed page as an unused one.  (Note: if we failed to
+	 * reinitialize the page here, we'd leave stale tuples behind for anyone
+	 * inspecting the index.  The page is zeroed again when it is reused.)
+	 */
+	MemSet(ovflpage, 0, BufferGetPageSize(ovflbuf));
+	_hash_pageinit(ovflpage, BufferGetPageSize(ovflbuf));
+	ovflopaque = (HashPageOpaque) PageGetSpecialPointer(ovflpage);
+	ovflopaque->hasho_prevblkno = InvalidBlockNumber;
+	ovflopaque->hasho_nextblkno = InvalidBlockNumber;
+	ovflopaque->hasho_bucket = -1;
+	ovflopaque->hasho_flag = LH_UNUSED_PAGE;
+	ovflopaque->hasho_page_id = HASHO_PAGE_ID;
+	MarkBufferDirty(ovflbuf);
+
+	/* Fix up the bucket chain, which is a doubly-linked list */
+	{
+		Page		prevpage = BufferGetPage(prevbuf);
+		HashPageOpaque prevopaque = (HashPageOpaque) PageGetSpecialPointer(prevpage);
+
+		Assert(prevopaque->hasho_bucket == bucket);
+		prevopaque->hasho_nextblkno = nextblkno;
+		MarkBufferDirty(prevbuf);
+	}
+	if (BufferIsValid(nextbuf))
+	{
+		Page		nextpage = BufferGetPage(nextbuf);
+		HashPageOpaque nextopaque = (HashPageOpaque) PageGetSpecialPointer(nextpage);
+
+		Assert(nextopaque->hasho_bucket == bucket);
+		nextopaque->hasho_prevblkno = prevblkno;
+		MarkBufferDirty(nextbuf);
+	}
+
+	/* Clear the bitmap bit to indicate that this overflow page is free */
+	CLRBIT(freep, bitmapbit);
+	MarkBufferDirty(mapbuf);
+
 	/* if this is now the first free page, update hashm_firstfree */
 	if (ovflbitno < metap->hashm_firstfree)
 	{
 		metap->hashm_firstfree = ovflbitno;
-		_hash_wrtbuf(rel, metabuf);
+		update_metap = true;
+		MarkBufferDirty(metabuf);
 	}
-	else
+
+	/* XLOG stuff */
+	if (RelationNeedsWAL(rel))
 	{
-		/* no need to change metapage */
-		_hash_relbuf(rel, metabuf);
+		XLogRecPtr	recptr;
+
+		XLogBeginInsert();
+
+		/*
+		 * The primary bucket page is always registered, so that replay can
+		 * get a cleanup lock on it, but it only needs an image if we changed
+		 * it.
+		 */
+		if (prevbuf == bucketbuf)
+			XLogRegisterBuffer(0, bucketbuf,
+							   REGBUF_FORCE_IMAGE | REGBUF_STANDARD);
+		else
+			XLogRegisterBuffer(0, bucketbuf, REGBUF_NO_IMAGE | REGBUF_STANDARD);
+
+		XLogRegisterBuffer(1, ovflbuf, REGBUF_FORCE_IMAGE | REGBUF_STANDARD);
+		if (prevbuf != bucketbuf)
+			XLogRegisterBuffer(2, prevbuf, REGBUF_FORCE_IMAGE | REGBUF_STANDARD);
+		if (BufferIsValid(nextbuf))
+			XLogRegisterBuffer(3, nextbuf, REGBUF_FORCE_IMAGE | REGBUF_STANDARD);
+		XLogRegisterBuffer(4, mapbuf, REGBUF_FORCE_IMAGE);
+		if (update_metap)
+			XLogRegisterBuffer(5, metabuf, REGBUF_FORCE_IMAGE);
+
+		recptr = XLogInsert(RM_HASH_ID, XLOG_HASH_FREE_OVFL_PAGE);
+
+		PageSetLSN(ovflpage, recptr);
+		PageSetLSN(BufferGetPage(prevbuf), recptr);
+		if (BufferIsValid(nextbuf))
+			PageSetLSN(BufferGetPage(nextbuf), recptr);
+		PageSetLSN(mappage, recptr);
+		if (update_metap)
+			PageSetLSN(BufferGetPage(metabuf), recptr);
 	}
 
+	END_CRIT_SECTION();
+
+	_hash_relbuf(rel, ovflbuf);
+	if (prevbuf == bucketbuf)
+		LockBuffer(prevbuf, BUFFER_LOCK_UNLOCK);
+	else
+		_hash_relbuf(rel, prevbuf);
+	if (BufferIsValid(nextbuf))
+		_hash_relbuf(rel, nextbuf);
+	_hash_relbuf(rel, mapbuf);
+	_hash_relbuf(rel, metabuf);
+
 	return nextblkno;
 }
 
 
 /*
- *	_hash_initbitmap()
- *
- *	 Initialize a new bitmap page.  The metapage has a write-lock upon
- *	 entering the function, and must be written by caller after return.
+ *	_hash_initbitmapbuffer()
  *
- * 'blkno' is the block number of the new bitmap page.
+ *	 Initialize a new bitmap page, which the caller has obtained with
+ *	 _hash_getnewbuf() and holds write-locked.  All bits in the new bitmap
+ *	 page are set to "1", indicating "in use".
  *
- * All bits in the new bitmap page are set to "1", indicating "in use".
+ *	 The caller is responsible for adding the page to the metapage's list of
+ *	 bitmaps and for WAL-logging both, normally with a full page image.
  */
 void
-_hash_initbitmap(Relation rel, HashMetaPage metap, BlockNumber blkno,
-				 ForkNumber forkNum)
+_hash_initbitmapbuffer(Buffer buf, uint16 bmsize)
 {
-	Buffer		buf;
 	Page		pg;
 	HashPageOpaque op;
 	uint32	   *freep;
 
-	/*
-	 * It is okay to write-lock the new bitmap page while holding metapage
-	 * write lock, because no one else could be contending for the new page.
-	 * Also, the metapage lock makes it safe to extend the index using
-	 * _hash_getnewbuf.
-	 *
-	 * There is some loss of concurrency in possibly doing I/O for the new
-	 * page while holding the metapage lock, but this path is taken so seldom
-	 * that it's not worth worrying about.
-	 */
-	buf = _hash_getnewbuf(rel, blkno, forkNum);
 	pg = BufferGetPage(buf);
 
 	/* initialize the page's special space */
@@ -533,22 +624,7 @@ _hash_initbitmap(Relation rel, HashMetaPage metap, BlockNumber blkno,
 
 	/* set all of the bits to 1 */
 	freep = HashPageGetBitmap(pg);
-	MemSet(freep, 0xFF, BMPGSZ_BYTE(metap));
-
-	/* write out the new bitmap page (releasing write lock and pin) */
-	_hash_wrtbuf(rel, buf);
-
-	/* add the new bitmap page to the metapage's list of bitmaps */
-	/* metapage already has a write lock */
-	if (metap->hashm_nmaps >= HASH_MAX_BITMAPS)
-		ereport(ERROR,
-				(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
-				 errmsg("out of overflow pages in hash index \"%s\"",
-						RelationGetRelationName(rel))));
-
-	metap->hashm_mapp[metap->hashm_nmaps] = blkno;
-
-	metap->hashm_nmaps++;
+	MemSet(freep, 0xFF, bmsize);
 }
 
 
@@ -570,6 +646,10 @@ _hash_initbitmap(Relation rel, HashMetaPage metap, BlockNumber blkno,
  *	required that to be true on entry as well, but it's a lot easier for
  *	callers to leave empty overflow pages and let this guy clean it up.
  *
+ *	Tuples are moved in batches, as many from the read page as fit on the
+ *	write page at a time, each batch being one WAL record.  The primary
+ *	bucket page stays pinned throughout, for the benefit of Hot Standby.
+ *
  *	Caller must hold exclusive lock on the target bucket.  This allows
  *	us to safely lock multiple pages in the bucket.
  *
@@ -584,13 +664,13 @@ _hash_squeezebucket(Relation rel,
 {
 	BlockNumber wblkno;
 	BlockNumber rblkno;
+	Buffer		bucketbuf;
 	Buffer		wbuf;
 	Buffer		rbuf;
 	Page		wpage;
 	Page		rpage;
 	HashPageOpaque wopaque;
 	HashPageOpaque ropaque;
-	bool		wbuf_dirty;
 
 	/*
 	 * start squeezing into the base bucket page.
@@ -613,6 +693,10 @@ _hash_squeezebucket(Relation rel,
 		return;
 	}
 
+	/* keep an extra pin on the primary bucket page until we're done */
+	bucketbuf = wbuf;
+	IncrBufferRefCount(bucketbuf);
+
 	/*
 	 * Find the last page in the bucket chain by starting at the base bucket
 	 * page and working forward.  Note: we assume that a hash bucket chain is
@@ -639,13 +723,14 @@ _hash_squeezebucket(Relation rel,
 	/*
 	 * squeeze the tuples.
 	 */
-	wbuf_dirty = false;
 	for (;;)
 	{
 		OffsetNumber roffnum;
 		OffsetNumber maxroffnum;
-		OffsetNumber deletable[MaxOffsetNumber];
-		int			ndeletable = 0;
+		OffsetNumber deletable[MaxIndexTuplesPerPage];
+		IndexTuple	itups[MaxIndexTuplesPerPage];
+		uint16		nitups = 0;
+		Size		space_needed = 0;
 
 		/* Scan each tuple in "read" page */
 		maxroffnum = PageGetMaxOffsetNumber(rpage);
@@ -662,59 +747,79 @@ _hash_squeezebucket(Relation rel,
 			itemsz = MAXALIGN(itemsz);
 
 			/*
-			 * Walk up the bucket chain, looking for a page big enough for
-			 * this item.  Exit if we reach the read page.
+			 * Walk up the bucket chain, looking for a page with room for this
+			 * item as well as those already collected for the current write
+			 * page.  Exit if we reach the read page.
 			 */
-			while (PageGetFreeSpace(wpage) < itemsz)
+			while (PageGetExactFreeSpace(wpage) <
+				   space_needed + itemsz + sizeof(ItemIdData))
 			{
+				Buffer		next_wbuf = InvalidBuffer;
+
 				Assert(!PageIsEmpty(wpage));
 
 				wblkno = wopaque->hasho_nextblkno;
 				Assert(BlockNumberIsValid(wblkno));
 
-				if (wbuf_dirty)
-					_hash_wrtbuf(rel, wbuf);
-				else
-					_hash_relbuf(rel, wbuf);
+				if (wblkno != rblkno)
+					next_wbuf = _hash_getbuf_with_strategy(rel,
+														   wblkno,
+														   HASH_WRITE,
+														   LH_OVERFLOW_PAGE,
+														   bstrategy);
 
-				/* nothing more to do if we reached the read page */
-				if (rblkno == wblkno)
+				/* move what we've collected so far to the write page */
+				if (nitups > 0)
 				{
-					if (ndeletable > 0)
+					_hash_movetuples(rel, bucketbuf, wbuf, rbuf,
+									 itups, nitups, deletable);
+					nitups = 0;
+					space_needed = 0;
+
+					/* the item offsets on the read page have changed */
+					if (wblkno != rblkno)
 					{
-						/* Delete tuples we already moved off read page */
-						PageIndexMultiDelete(rpage, deletable, ndeletable);
-						_hash_wrtbuf(rel, rbuf);
+						_hash_relbuf(rel, wbuf);
+						wbuf = next_wbuf;
+						wpage = BufferGetPage(wbuf);
+						wopaque = (HashPageOpaque) PageGetSpecialPointer(wpage);
+						Assert(wopaque->hasho_bucket == bucket);
+						goto readpage_again;
 					}
-					else
-						_hash_relbuf(rel, rbuf);
+				}
+
+				_hash_relbuf(rel, wbuf);
+
+				/* nothing more to do if we reached the read page */
+				if (rblkno == wblkno)
+				{
+					_hash_relbuf(rel, rbuf);
+					_hash_dropbuf(rel, bucketbuf);
 					return;
 				}
 
-				wbuf = _hash_getbuf_with_strategy(rel,
-												  wblkno,
-												  HASH_WRITE,
-												  LH_OVERFLOW_PAGE,
-												  bstrategy);
+				wbuf = next_wbuf;
 				wpage = BufferGetPage(wbuf);
 				wopaque = (HashPageOpaque) PageGetSpecialPointer(wpage);
 				Assert(wopaque->hasho_bucket == bucket);
-				wbuf_dirty = false;
 			}
 
 			/*
-			 * we have found room so insert on the "write" page, being careful
-			 * to preserve hashkey ordering.  (If we insert many tuples into
-			 * the same "write" page it would be worth qsort'ing instead of
-			 * doing repeated _hash_pgaddtup.)
+			 * We have found room on the "write" page; remember the tuple for
+			 * moving there.  We copy it, since the read page is changed in
+			 * the same critical section that logs it.
 			 */
-			(void) _hash_pgaddtup(rel, wbuf, itemsz, itup);
-			wbuf_dirty = true;
-
-			/* remember tuple for deletion from "read" page */
-			deletable[ndeletable++] = roffnum;
+			itups[nitups] = CopyIndexTuple(itup);
+			deletable[nitups] = roffnum;
+			nitups++;
+			space_needed += itemsz + sizeof(ItemIdData);
 		}
 
+		/* move the rest of the read page, if anything */
+		if (nitups > 0)
+			_hash_movetuples(rel, bucketbuf, wbuf, rbuf,
+							 itups, nitups, deletable);
+
 		/*
 		 * If we reach here, there are no live tuples on the "read" page ---
 		 * it was empty when we got to it, or we moved them all.  So we can
@@ -734,18 +839,16 @@ _hash_squeezebucket(Relation rel,
 		if (rblkno == wblkno)
 		{
 			/* yes, so release wbuf lock first */
-			if (wbuf_dirty)
-				_hash_wrtbuf(rel, wbuf);
-			else
-				_hash_relbuf(rel, wbuf);
+			_hash_relbuf(rel, wbuf);
 			/* free this overflow page (releases rbuf) */
-			_hash_freeovflpage(rel, rbuf, bstrategy);
+			_hash_freeovflpage(rel, bucketbuf, rbuf, bstrategy);
 			/* done */
+			_hash_dropbuf(rel, bucketbuf);
 			return;
 		}
 
 		/* free this overflow page, then get the previous one */
-		_hash_freeovflpage(rel, rbuf, bstrategy);
+		_hash_freeovflpage(rel, bucketbuf, rbuf, bstrategy);
 
 		rbuf = _hash_getbuf_with_strategy(rel,
 										  rblkno,
@@ -755,7 +858,83 @@ _hash_squeezebucket(Relation rel,
 		rpage = BufferGetPage(rbuf);
 		ropaque = (HashPageOpaque) PageGetSpecialPointer(rpage);
 		Assert(ropaque->hasho_bucket == bucket);
+
+readpage_again:
+		;
 	}
 
 	/* NOTREACHED */
 }
+
+/*
+ *	_hash_movetuples() -- move tuples from the "read" page of a squeeze to
+ *		the "write" page.
+ *
+ * itups[] are palloc'd copies of the tuples at offsets deletable[] of the
+ * read page, in ascending order; they are freed here.  Both pages must be
+ * write-locked, and the caller must have checked that the tuples fit.
+ */
+static void
+_hash_movetuples(Relation rel, Buffer bucketbuf, Buffer wbuf, Buffer rbuf,
+				 IndexTuple *itups, uint16 nitups, OffsetNumber *deletable)
+{
+	bool		is_prim_bucket_same_wrt = (wbuf == bucketbuf);
+	uint16		i;
+
+	/* each tuple is a separate rdata entry */
+	if (RelationNeedsWAL(rel))
+		XLogEnsureRecordSpace(0, 3 + nitups);
+
+	/* No ereport(ERROR) until changes are logged */
+	START_CRIT_SECTION();
+
+	/*
+	 * Insert the tuples on the write page, using _hash_pgaddtup to preserve
+	 * hashkey ordering, and delete them from the read page.
+	 */
+	for (i = 0; i < nitups; i++)
+		(void) _hash_pgaddtup(rel, wbuf, IndexTupleDSize(*itups[i]), itups[i]);
+	PageIndexMultiDelete(BufferGetPage(rbuf), deletable, nitups);
+
+	MarkBufferDirty(wbuf);
+	MarkBufferDirty(rbuf);
+
+	/* XLOG stuff */
+	if (RelationNeedsWAL(rel))
+	{
+		xl_hash_move_page_contents xlrec;
+		XLogRecPtr	recptr;
+
+		xlrec.ntups = nitups;
+		xlrec.is_prim_bucket_same_wrt = is_prim_bucket_same_wrt;
+
+		XLogBeginInsert();
+		XLogRegisterData((char *) &xlrec, SizeOfHashMovePageContents);
+
+		/*
+		 * The primary bucket page is registered, without an image, only so
+		 * that replay can get a cleanup lock on it.
+		 */
+		if (!is_prim_bucket_same_wrt)
+			XLogRegisterBuffer(0, bucketbuf, REGBUF_NO_IMAGE | REGBUF_STANDARD);
+
+		XLogRegisterBuffer(1, wbuf, REGBUF_STANDARD);
+		for (i = 0; i < nitups; i++)
+			XLogRegisterBufData(1, (char *) itups[i],
+								IndexTupleDSize(*itups[i]));
+
+		XLogRegisterBuffer(2, rbuf, REGBUF_STANDARD);
+		XLogRegisterBufData(2, (char *) deletable,
+							nitups * sizeof(OffsetNumber));
+
+		recptr = XLogInsert(RM_HASH_ID, XLOG_HASH_MOVE_PAGE_CONTENTS);
+
+		PageSetLSN(BufferGetPage(wbuf), recptr);
+		PageSetLSN(BufferGetPage(rbuf), recptr);
+	}
+
+	END_CRIT_SECTION();
+
+	for (i = 0; i < nitups; i++)
+		pfree(itups[i]);
+}
@@ -29,6 +29,7 @@
 #include "postgres.h"
 
 #include "access/hash.h"
+#include "access/xloginsert.h"
 #include "miscadmin.h"
 #include "storage/lmgr.h"
 #include "storage/smgr.h"
@@ -36,12 +37,17 @@
 
 static bool _hash_alloc_buckets(Relation rel, BlockNumber firstblock,
 					uint32 nblocks);
-static void _hash_splitbucket(Relation rel, Buffer metabuf,
-				  Bucket obucket, Bucket nbucket,
-				  BlockNumber start_oblkno,
-				  Buffer nbuf,
-				  uint32 maxbucket,
-				  uint32 highmask, uint32 lowmask);
+static bool _hash_splitbucket_copy(Relation rel, Buffer metabuf,
+					   Bucket obucket, Bucket nbucket,
+					   BlockNumber start_oblkno,
+					   BlockNumber start_nblkno,
+					   uint32 maxbucket,
+					   uint32 highmask, uint32 lowmask,
+					   bool all);
+static bool _hash_splitbucket_cleanup(Relation rel, Bucket obucket,
+						  BlockNumber start_oblkno);
+static void _hash_set_splitstate(Relation rel, Buffer metabuf,
+					 uint32 splitstate);
 
 
 /*
@@ -265,25 +271,6 @@ _hash_dropbuf(Relation rel, Buffer buf)
 	ReleaseBuffer(buf);
 }
 
-/*
- *	_hash_wrtbuf() -- write a hash page to disk.
- *
- *		This routine releases the lock held on the buffer and our refcount
- *		for it.  It is an error to call _hash_wrtbuf() without a write lock
- *		and a pin on the buffer.
- *
- * NOTE: this routine should go away when/if hash indexes are WAL-ified.
- * The correct sequence of operations is to mark the buffer dirty, then
- * write the WAL record, then release the lock and pin; so marking dirty
- * can't be combined with releasing.
- */
-void
-_hash_wrtbuf(Relation rel, Buffer buf)
-{
-	MarkBufferDirty(buf);
-	UnlockReleaseBuffer(buf);
-}
-
 /*
  * _hash_chgbufaccess() -- Change the lock type on a buffer, without
  *			dropping our pin on it.
@@ -322,6 +309,10 @@ _hash_chgbufaccess(Relation rel,
  * We are fairly cavalier about locking here, since we know that no one else
  * could be accessing this index.  In particular the rule about not holding
  * multiple buffer locks is ignored.
+ *
+ * Each page is WAL-logged as a full page image once it is initialized.
+ * That is also needed for the init fork of an unlogged index, which has to
+ * survive a crash (compare ginbuildempty()).
  */
 uint32
 _hash_metapinit(Relation rel, double num_tuples, ForkNumber forkNum)
@@ -338,12 +329,15 @@ _hash_metapinit(Relation rel, double num_tuples, ForkNumber forkNum)
 	uint32		num_buckets;
 	uint32		log2_num_buckets;
 	uint32		i;
+	bool		use_wal;
 
 	/* safety check */
 	if (RelationGetNumberOfBlocksInFork(rel, forkNum) != 0)
 		elog(ERROR, "cannot initialize non-empty hash index \"%s\"",
 			 RelationGetRelationName(rel));
 
+	use_wal = RelationNeedsWAL(rel) || forkNum == INIT_FORKNUM;
+
 	/*
 	 * Determine the target fill factor (in tuples per bucket) for this index.
 	 * The idea is to make the fill factor correspond to pages about as full
@@ -435,6 +429,8 @@ _hash_metapinit(Relation rel, double num_tuples, ForkNumber forkNum)
 	metap->hashm_ovflpoint = log2_num_buckets;
 	metap->hashm_firstfree = 0;
 
+	metap->hashm_splitstate = HASH_SPLIT_NONE;
+
 	/*
 	 * Release buffer lock on the metapage while we initialize buckets.
 	 * Otherwise, we'll be in interrupt holdoff and the CHECK_FOR_INTERRUPTS
@@ -453,25 +449,47 @@ _hash_metapinit(Relation rel, double num_tuples, ForkNumber forkNum)
 
 		buf = _hash_getnewbuf(rel, BUCKET_TO_BLKNO(metap, i), forkNum);
 		pg = BufferGetPage(buf);
+
+		START_CRIT_SECTION();
 		pageopaque = (HashPageOpaque) PageGetSpecialPointer(pg);
 		pageopaque->hasho_prevblkno = InvalidBlockNumber;
 		pageopaque->hasho_nextblkno = InvalidBlockNumber;
 		pageopaque->hasho_bucket = i;
 		pageopaque->hasho_flag = LH_BUCKET_PAGE;
 		pageopaque->hasho_page_id = HASHO_PAGE_ID;
-		_hash_wrtbuf(rel, buf);
+		MarkBufferDirty(buf);
+		if (use_wal)
+			log_newpage_buffer(buf, true);
+		END_CRIT_SECTION();
+
+		_hash_relbuf(rel, buf);
 	}
 
 	/* Now reacquire buffer lock on metapage */
 	_hash_chgbufaccess(rel, metabuf, HASH_NOLOCK, HASH_WRITE);
 
 	/*
-	 * Initialize first bitmap page
+	 * Initialize first bitmap page, and add it to the metapage's list of
+	 * bitmaps.
 	 */
-	_hash_initbitmap(rel, metap, num_buckets + 1, forkNum);
+	buf = _hash_getnewbuf(rel, num_buckets + 1, forkNum);
+
+	START_CRIT_SECTION();
+	_hash_initbitmapbuffer(buf, metap->hashm_bmsize);
+	MarkBufferDirty(buf);
+	if (use_wal)
+		log_newpage_buffer(buf, false);
+
+	metap->hashm_mapp[metap->hashm_nmaps] = num_buckets + 1;
+	metap->hashm_nmaps++;
+	MarkBufferDirty(metabuf);
+	if (use_wal)
+		log_newpage_buffer(metabuf, false);
+	END_CRIT_SECTION();
 
 	/* all done */
-	_hash_wrtbuf(rel, metabuf);
+	_hash_relbuf(rel, buf);
+	_hash_relbuf(rel, metabuf);
 
 	return num_buckets;
 }
@@ -486,10 +504,22 @@ _hash_pageinit(Page page, Size size)
 	PageInit(page, size, sizeof(HashPageOpaqueData));
 }
 
+
 /*
  * Attempt to expand the hash table by creating one new bucket.
  *
- * This will silently do nothing if it cannot get the needed locks.
+ * This will silently do nothing if a split turns out not to be needed, or
+ * the index can't be extended any further.  Only one split can be in
+ * progress at a time, so if the previous one isn't finished yet, we do a
+ * step of that one instead.
+ *
+ * Beginning a split only allocates the new bucket's primary page and makes
+ * the metapage say that the bucket exists, in a single WAL record.  The
+ * tuples that belong in the new bucket are then copied over a little at a
+ * time by _hash_split_step(), the first step of which we do here and the
+ * rest of which are done by later insertions and by VACUUM.  Until the
+ * copying is complete such tuples are still looked for, and inserted, in
+ * the old bucket (see _hash_getbucket()), so nobody has to wait for it.
  *
  * The caller should hold no locks on the hash index.
  *
@@ -500,15 +530,12 @@ void
 _hash_expandtable(Relation rel, Buffer metabuf)
 {
 	HashMetaPage metap;
-	Bucket		old_bucket;
 	Bucket		new_bucket;
 	uint32		spare_ndx;
-	BlockNumber start_oblkno;
 	BlockNumber start_nblkno;
 	Buffer		buf_nblkno;
-	uint32		maxbucket;
-	uint32		highmask;
-	uint32		lowmask;
+	Page		npage;
+	HashPageOpaque nopaque;
 
 	/*
 	 * Write-lock the meta page.  It used to be necessary to acquire a
@@ -519,6 +546,14 @@ _hash_expandtable(Relation rel, Buffer metabuf)
 	_hash_checkpage(rel, metabuf, LH_META_PAGE);
 	metap = HashPageGetMeta(BufferGetPage(metabuf));
 
+	/* If the previous split isn't done, help it along instead */
+	if (metap->hashm_splitstate != HASH_SPLIT_NONE)
+	{
+		_hash_chgbufaccess(rel, metabuf, HASH_READ, HASH_NOLOCK);
+		(void) _hash_split_step(rel, metabuf);
+		return;
+	}
+
 	/*
 	 * Check to see if split is still needed; someone else might have already
 	 * done one while we waited for the lock.
@@ -548,39 +583,18 @@ _hash_expandtable(Relation rel, Buffer metabuf)
 		goto fail;
 
 	/*
-	 * Determine which bucket is to be split, and attempt to lock the old
-	 * bucket.  If we can't get the lock, give up.
-	 *
-	 * The lock protects us against other backends, but not against our own
-	 * backend.  Must check for active scans separately.
-	 */
-	new_bucket = metap->hashm_maxbucket + 1;
-
-	old_bucket = (new_bucket & metap->hashm_lowmask);
-
-	start_oblkno = BUCKET_TO_BLKNO(metap, old_bucket);
-
-	if (_hash_has_active_scan(rel, old_bucket))
-		goto fail;
-
-	if (!_hash_try_getlock(rel, start_oblkno, HASH_EXCLUSIVE))
-		goto fail;
-
-	/*
-	 * Likewise lock the new bucket (should never fail).
+	 * Determine the new bucket.  No heavyweight locks are needed to create
+	 * it: nobody looks at it until the first split step copies tuples into
+	 * it, and the old bucket isn't changed at all yet.
 	 *
 	 * Note: it is safe to compute the new bucket's blkno here, even though we
 	 * may still need to update the BUCKET_TO_BLKNO mapping.  This is because
 	 * the current value of hashm_spares[hashm_ovflpoint] correctly shows
 	 * where we are going to put a new splitpoint's worth of buckets.
 	 */
-	start_nblkno = BUCKET_TO_BLKNO(metap, new_bucket);
-
-	if (_hash_has_active_scan(rel, new_bucket))
-		elog(ERROR, "scan in progress on supposedly new bucket");
+	new_bucket = metap->hashm_maxbucket + 1;
 
-	if (!_hash_try_getlock(rel, start_nblkno, HASH_EXCLUSIVE))
-		elog(ERROR, "could not get lock on supposedly new bucket");
+	start_nblkno = BUCKET_TO_BLKNO(metap, new_bucket);
 
 	/*
 	 * If the split point is increasing (hashm_maxbucket's log base 2
@@ -600,8 +614,6 @@ _hash_expandtable(Relation rel, Buffer metabuf)
 		if (!_hash_alloc_buckets(rel, start_nblkno, new_bucket))
 		{
 			/* can't split due to BlockNumber overflow */
-			_hash_droplock(rel, start_oblkno, HASH_EXCLUSIVE);
-			_hash_droplock(rel, start_nblkno, HASH_EXCLUSIVE);
 			goto fail;
 		}
 	}
@@ -612,15 +624,11 @@ _hash_expandtable(Relation rel, Buffer metabuf)
 	 * disk space.
 	 */
 	buf_nblkno = _hash_getnewbuf(rel, start_nblkno, MAIN_FORKNUM);
+	npage = BufferGetPage(buf_nblkno);
 
 	/*
-	 * Okay to proceed with split.  Update the metapage bucket mapping info.
-	 *
-	 * Since we are scribbling on the metapage data right in the shared
-	 * buffer, any failure in this next little bit leaves us with a big
-	 * problem: the metapage is effectively corrupt but could get written back
-	 * to disk.  We don't really expect any failure, but just to be sure,
-	 * establish a critical section.
+	 * Okay to proceed with split.  Update the metapage bucket mapping info,
+	 * and initialize the new bucket's primary page.
 	 */
 	START_CRIT_SECTION();
 
@@ -645,36 +653,48 @@ _hash_expandtable(Relation rel, Buffer metabuf)
 		metap->hashm_ovflpoint = spare_ndx;
 	}
 
-	/* Done mucking with metapage */
-	END_CRIT_SECTION();
+	metap->hashm_splitstate = HASH_SPLIT_COPYING;
 
-	/*
-	 * Copy bucket mapping info now; this saves re-accessing the meta page
-	 * inside _hash_splitbucket's inner loop.  Note that once we drop the
-	 * split lock, other splits could begin, so these values might be out of
-	 * date before _hash_splitbucket finishes.  That's okay, since all it
-	 * needs is to tell which of these two buckets to map hashkeys into.
-	 */
-	maxbucket = metap->hashm_maxbucket;
-	highmask = metap->hashm_highmask;
-	lowmask = metap->hashm_lowmask;
+	MarkBufferDirty(metabuf);
 
-	/* Write out the metapage and drop lock, but keep pin */
-	_hash_chgbufaccess(rel, metabuf, HASH_WRITE, HASH_NOLOCK);
+	nopaque = (HashPageOpaque) PageGetSpecialPointer(npage);
+	nopaque->hasho_prevblkno = InvalidBlockNumber;
+	nopaque->hasho_nextblkno = InvalidBlockNumber;
+	nopaque->hasho_bucket = new_bucket;
+	nopaque->hasho_flag = LH_BUCKET_PAGE;
+	nopaque->hasho_page_id = HASHO_PAGE_ID;
+
+	MarkBufferDirty(buf_nblkno);
+
+	/* XLOG stuff */
+	if (RelationNeedsWAL(rel))
+	{
+		XLogRecPtr	recptr;
 
-	/* Relocate records to the new bucket */
-	_hash_splitbucket(rel, metabuf,
-					  old_bucket, new_bucket,
-					  start_oblkno, buf_nblkno,
-					  maxbucket, highmask, lowmask);
+		XLogBeginInsert();
 
-	/* Release bucket locks, allowing others to access them */
-	_hash_droplock(rel, start_oblkno, HASH_EXCLUSIVE);
-	_hash_droplock(rel, start_nblkno, HASH_EXCLUSIVE);
+		XLogRegisterBuffer(0, buf_nblkno, REGBUF_FORCE_IMAGE | REGBUF_STANDARD);
+		XLogRegisterBuffer(1, metabuf, REGBUF_FORCE_IMAGE);
+
+		recptr = XLogInsert(RM_HASH_ID, XLOG_HASH_SPLIT_ALLOCATE);
+
+		PageSetLSN(npage, recptr);
+		PageSetLSN(BufferGetPage(metabuf), recptr);
+	}
+
+	END_CRIT_SECTION();
+
+	_hash_relbuf(rel, buf_nblkno);
+
+	/* Drop metapage lock, but keep pin */
+	_hash_chgbufaccess(rel, metabuf, HASH_READ, HASH_NOLOCK);
+
+	/* Get the copying started */
+	(void) _hash_split_step(rel, metabuf);
 
 	return;
 
-	/* Here if decide not to split or fail to acquire old bucket lock */
+	/* Here if decide not to split */
 fail:
 
 	/* We didn't write the metapage, so just drop lock */
@@ -690,15 +710,19 @@ fail:
  * EOF to the end of the splitpoint; this keeps smgr's idea of the EOF in
  * sync with ours, so that we don't get complaints from smgr.
  *
- * We do this by writing a page of zeroes at the end of the splitpoint range.
- * We expect that the filesystem will ensure that the intervening pages read
+ * We do this by writing a page at the end of the splitpoint range.  We
+ * expect that the filesystem will ensure that the intervening pages read
  * as zeroes too.  On many filesystems this "hole" will not be allocated
  * immediately, which means that the index file may end up more fragmented
  * than if we forced it all to be allocated now; but since we don't scan
  * hash indexes sequentially anyway, that probably doesn't matter.
  *
+ * The page is WAL-logged, which also makes replay extend the relation.  It
+ * is initialized as an unused page rather than left zeroed, so that it has
+ * a valid header to set the LSN in.
+ *
  * XXX It's annoying that this code is executed with the metapage lock held.
- * We need to interlock against _hash_getovflpage() adding a new overflow page
+ * We need to interlock against _hash_addovflpage() adding a new overflow page
  * concurrently, but it'd likely be better to use LockRelationForExtension
  * for the purpose.  OTOH, adding a splitpoint is a very infrequent operation,
  * so it may not be worth worrying about.
@@ -710,7 +734,8 @@ static bool
 _hash_alloc_buckets(Relation rel, BlockNumber firstblock, uint32 nblocks)
 {
 	BlockNumber lastblock;
-	char		zerobuf[BLCKSZ];
+	Page		page;
+	HashPageOpaque opaque;
 
 	lastblock = firstblock + nblocks - 1;
 
@@ -721,184 +746,581 @@ _hash_alloc_buckets(Relation rel, BlockNumber firstblock, uint32 nblocks)
 	if (lastblock < firstblock || lastblock == InvalidBlockNumber)
 		return false;
 
-	MemSet(zerobuf, 0, sizeof(zerobuf));
+	page = (Page) palloc0(BLCKSZ);
+
+	_hash_pageinit(page, BLCKSZ);
+	opaque = (HashPageOpaque) PageGetSpecialPointer(page);
+	opaque->hasho_prevblkno = InvalidBlockNumber;
+	opaque->hasho_nextblkno = InvalidBlockNumber;
+	opaque->hasho_bucket = -1;
+	opaque->hasho_flag = LH_UNUSED_PAGE;
+	opaque->hasho_page_id = HASHO_PAGE_ID;
+
+	if (RelationNeedsWAL(rel))
+		log_newpage(&rel->rd_node, MAIN_FORKNUM, lastblock, page, true);
 
 	RelationOpenSmgr(rel);
-	smgrextend(rel->rd_smgr, MAIN_FORKNUM, lastblock, zerobuf, false);
+	PageSetChecksumInplace(page, lastblock);
+	smgrextend(rel->rd_smgr, MAIN_FORKNUM, lastblock, (char *) page, false);
+
+	pfree(page);
 
 	return true;
 }
 
 
 /*
- * _hash_splitbucket -- split 'obucket' into 'obucket' and 'nbucket'
+ * _hash_split_step -- do a unit of work on the bucket split in progress
  *
- * We are splitting a bucket that consists of a base bucket page and zero
- * or more overflow (bucket chain) pages.  We must relocate tuples that
- * belong in the new bucket, and compress out any free space in the old
- * bucket.
+ * While hashm_splitstate is HASH_SPLIT_COPYING, a step copies the tuples
+ * that belong in the new bucket from one page of the old bucket.  When it
+ * finds nothing left to copy, it tries to lock the old bucket exclusively,
+ * which keeps any more such tuples from arriving there; then it copies any
+ * that did arrive meanwhile and advances the state to HASH_SPLIT_CLEANUP.
+ * From then on, searches and insertions use the new bucket, and each step
+ * deletes the copied tuples from one page of the old bucket.  When there are
+ * none left, the old bucket is squeezed and the split is over.
  *
- * The caller must hold exclusive locks on both buckets to ensure that
- * no one else is trying to access them (see README).
+ * Only conditional heavyweight locks are taken, so a step never waits for
+ * scans or insertions to finish; if it can't get the locks it wants, it
+ * just does nothing.  Returns TRUE if it made progress, so that VACUUM can
+ * tell whether calling again is useful.
  *
- * The caller must hold a pin, but no lock, on the metapage buffer.
- * The buffer is returned in the same state.  (The metapage is only
- * touched if it becomes necessary to add or remove overflow pages.)
+ * The caller should hold no locks on the hash index.
  *
- * In addition, the caller must have created the new bucket's base page,
- * which is passed in buffer nbuf, pinned and write-locked.  That lock and
- * pin are released here.  (The API is set up this way because we must do
- * _hash_getnewbuf() before releasing the metapage write lock.  So instead of
- * passing the new bucket's start block number, we pass an actual buffer.)
+ * The caller must hold a pin, but no lock, on the metapage buffer.
+ * The buffer is returned in the same state.
  */
-static void
-_hash_splitbucket(Relation rel,
-				  Buffer metabuf,
-				  Bucket obucket,
-				  Bucket nbucket,
-				  BlockNumber start_oblkno,
-				  Buffer nbuf,
-				  uint32 maxbucket,
-				  uint32 highmask,
-				  uint32 lowmask)
+bool
+_hash_split_step(Relation rel, Buffer metabuf)
 {
-	Buffer		obuf;
-	Page		opage;
-	Page		npage;
-	HashPageOpaque oopaque;
-	HashPageOpaque nopaque;
+	HashMetaPage metap;
+	uint32		splitstate;
+	Bucket		old_bucket;
+	Bucket		new_bucket;
+	BlockNumber start_oblkno;
+	BlockNumber start_nblkno;
+	uint32		maxbucket;
+	uint32		highmask;
+	uint32		lowmask;
+	bool		unchanged;
+	bool		progress = false;
+
+	_hash_chgbufaccess(rel, metabuf, HASH_NOLOCK, HASH_READ);
+
+	_hash_checkpage(rel, metabuf, LH_META_PAGE);
+	metap = HashPageGetMeta(BufferGetPage(metabuf));
 
 	/*
-	 * It should be okay to simultaneously write-lock pages from each bucket,
-	 * since no one else can be trying to acquire buffer lock on pages of
-	 * either bucket.
+	 * The split in progress, if any, is always the one that created the
+	 * highest-numbered bucket.  Copy the mapping info now; it doesn't change
+	 * until the split is finished.
 	 */
-	obuf = _hash_getbuf(rel, start_oblkno, HASH_WRITE, LH_BUCKET_PAGE);
-	opage = BufferGetPage(obuf);
-	oopaque = (HashPageOpaque) PageGetSpecialPointer(opage);
+	splitstate = metap->hashm_splitstate;
+	maxbucket = metap->hashm_maxbucket;
+	highmask = metap->hashm_highmask;
+	lowmask = metap->hashm_lowmask;
 
-	npage = BufferGetPage(nbuf);
+	new_bucket = maxbucket;
+	old_bucket = new_bucket & lowmask;
+	start_oblkno = BUCKET_TO_BLKNO(metap, old_bucket);
+	start_nblkno = BUCKET_TO_BLKNO(metap, new_bucket);
 
-	/* initialize the new bucket's primary page */
-	nopaque = (HashPageOpaque) PageGetSpecialPointer(npage);
-	nopaque->hasho_prevblkno = InvalidBlockNumber;
-	nopaque->hasho_nextblkno = InvalidBlockNumber;
-	nopaque->hasho_bucket = nbucket;
-	nopaque->hasho_flag = LH_BUCKET_PAGE;
-	nopaque->hasho_page_id = HASHO_PAGE_ID;
+	_hash_chgbufaccess(rel, metabuf, HASH_READ, HASH_NOLOCK);
+
+	if (splitstate == HASH_SPLIT_NONE)
+		return false;
 
 	/*
-	 * Partition the tuples in the old bucket between the old bucket and the
-	 * new bucket, advancing along the old bucket's overflow bucket chain and
-	 * adding overflow pages to the new bucket as needed.  Outer loop iterates
-	 * once per page in old bucket.
+	 * While copying, the exclusive lock on the new bucket makes us the only
+	 * one working on the split (nobody else uses that bucket yet), and the
+	 * share lock on the old bucket keeps VACUUM from moving its tuples
+	 * around underneath us while still letting insertions and scans proceed.
+	 * Deleting tuples from the old bucket needs an exclusive lock on it, and
+	 * our own backend's scans have to be checked for separately, since the
+	 * lock doesn't protect against those.
 	 */
-	for (;;)
+	if (splitstate == HASH_SPLIT_COPYING)
+	{
+		if (!_hash_try_getlock(rel, start_nblkno, HASH_EXCLUSIVE))
+			return false;
+		if (!_hash_try_getlock(rel, start_oblkno, HASH_SHARE))
+		{
+			_hash_droplock(rel, start_nblkno, HASH_EXCLUSIVE);
+			return false;
+		}
+	}
+	else
+	{
+		Assert(splitstate == HASH_SPLIT_CLEANUP);
+		if (_hash_has_active_scan(rel, old_bucket))
+			return false;
+		if (!_hash_try_getlock(rel, start_oblkno, HASH_EXCLUSIVE))
+			return false;
+	}
+
+	/*
+	 * Now that we hold the locks, make sure someone else hasn't finished this
+	 * stage of the split (or the whole split, and begun another one) while
+	 * we weren't looking.
+	 */
+	_hash_chgbufaccess(rel, metabuf, HASH_NOLOCK, HASH_READ);
+	unchanged = (metap->hashm_splitstate == splitstate &&
+				 metap->hashm_maxbucket == maxbucket);
+	_hash_chgbufaccess(rel, metabuf, HASH_READ, HASH_NOLOCK);
+
+	if (splitstate == HASH_SPLIT_COPYING)
+	{
+		if (unchanged)
+		{
+			progress = _hash_splitbucket_copy(rel, metabuf,
+											  old_bucket, new_bucket,
+											  start_oblkno, start_nblkno,
+											  maxbucket, highmask, lowmask,
+											  false);
+
+			/*
+			 * If there was nothing to copy, we're done copying, provided no
+			 * one is adding tuples to the old bucket.  An exclusive lock on
+			 * it makes sure of that.  (We already hold a share lock, but that
+			 * doesn't conflict with our own request.)
+			 */
+			if (!progress &&
+				_hash_try_getlock(rel, start_oblkno, HASH_EXCLUSIVE))
+			{
+				(void) _hash_splitbucket_copy(rel, metabuf,
+											  old_bucket, new_bucket,
+											  start_oblkno, start_nblkno,
+											  maxbucket, highmask, lowmask,
+											  true);
+				_hash_set_splitstate(rel, metabuf, HASH_SPLIT_CLEANUP);
+				_hash_droplock(rel, start_oblkno, HASH_EXCLUSIVE);
+				progress = true;
+			}
+		}
+
+		_hash_droplock(rel, start_oblkno, HASH_SHARE);
+		_hash_droplock(rel, start_nblkno, HASH_EXCLUSIVE);
+	}
+	else
 	{
-		BlockNumber oblkno;
+		if (unchanged)
+		{
+			if (!_hash_splitbucket_cleanup(rel, old_bucket, start_oblkno))
+			{
+				/* nothing left to delete, so finish up */
+				_hash_squeezebucket(rel, old_bucket, start_oblkno, NULL);
+				_hash_set_splitstate(rel, metabuf, HASH_SPLIT_NONE);
+			}
+			progress = true;
+		}
+
+		_hash_droplock(rel, start_oblkno, HASH_EXCLUSIVE);
+	}
+
+	return progress;
+}
+
+/*
+ * _hash_set_splitstate -- change hashm_splitstate
+ *
+ * The caller must hold a pin, but no lock, on the metapage buffer.
+ * The buffer is returned in the same state.
+ */
+static void
+_hash_set_splitstate(Relation rel, Buffer metabuf, uint32 splitstate)
+{
+	HashMetaPage metap;
+
+	_hash_chgbufaccess(rel, metabuf, HASH_NOLOCK, HASH_WRITE);
+	metap = HashPageGetMeta(BufferGetPage(metabuf));
+
+	START_CRIT_SECTION();
+
+	metap->hashm_splitstate = splitstate;
+	MarkBufferDirty(metabuf);
+
+	/* XLOG stuff */
+	if (RelationNeedsWAL(rel))
+	{
+		xl_hash_split_state xlrec;
+		XLogRecPtr	recptr;
+
+		xlrec.splitstate = splitstate;
+
+		XLogBeginInsert();
+		XLogRegisterData((char *) &xlrec, SizeOfHashSplitState);
+		XLogRegisterBuffer(0, metabuf, 0);
+
+		recptr = XLogInsert(RM_HASH_ID, XLOG_HASH_SPLIT_STATE);
+
+		PageSetLSN(BufferGetPage(metabuf), recptr);
+	}
+
+	END_CRIT_SECTION();
+
+	_hash_chgbufaccess(rel, metabuf, HASH_READ, HASH_NOLOCK);
+}
+
+
+/*
+ * _hash_splitbucket_copy -- copy tuples from 'obucket' that belong in
+ *		'nbucket' and haven't been copied yet
+ *
+ * Normally we do only the first page of the old bucket that has any such
+ * tuples; if 'all' is true, we go through the whole bucket.  The copies are
+ * added at the end of the new bucket, adding overflow pages to it as needed,
+ * in batches that fill one page of the new bucket.  Each batch is a single
+ * WAL record, which also covers setting HASH_COPIED_BY_SPLIT on the
+ * originals, so a crash can neither lose tuples nor copy them twice.
+ *
+ * Returns TRUE if anything was copied.
+ *
+ * The caller must hold exclusive lock on the new bucket and at least share
+ * lock on the old one.
+ *
+ * The caller must hold a pin, but no lock, on the metapage buffer.
+ * The buffer is returned in the same state.  (The metapage is only
+ * touched if it becomes necessary to add overflow pages.)
+ */
+static bool
+_hash_splitbucket_copy(Relation rel,
+					   Buffer metabuf,
+					   Bucket obucket,
+					   Bucket nbucket,
+					   BlockNumber start_oblkno,
+					   BlockNumber start_nblkno,
+					   uint32 maxbucket,
+					   uint32 highmask,
+					   uint32 lowmask,
+					   bool all)
+{
+	BlockNumber oblkno = start_oblkno;
+	bool		copied = false;
+
+	while (BlockNumberIsValid(oblkno))
+	{
+		Buffer		obuf;
+		Buffer		nbuf;
+		Page		opage;
+		Page		npage;
+		HashPageOpaque oopaque;
+		HashPageOpaque nopaque;
 		OffsetNumber ooffnum;
 		OffsetNumber omaxoffnum;
-		OffsetNumber deletable[MaxOffsetNumber];
-		int			ndeletable = 0;
+		bool		found = false;
+
+		/*
+		 * Look at the page with just a share lock first, since most pages
+		 * have nothing left to copy when we get to them.
+		 */
+		obuf = _hash_getbuf(rel, oblkno, HASH_READ,
+							LH_BUCKET_PAGE | LH_OVERFLOW_PAGE);
+		opage = BufferGetPage(obuf);
+		oopaque = (HashPageOpaque) PageGetSpecialPointer(opage);
+		Assert(oopaque->hasho_bucket == obucket);
 
-		/* Scan each tuple in old page */
 		omaxoffnum = PageGetMaxOffsetNumber(opage);
 		for (ooffnum = FirstOffsetNumber;
 			 ooffnum <= omaxoffnum;
 			 ooffnum = OffsetNumberNext(ooffnum))
 		{
 			IndexTuple	itup;
-			Size		itemsz;
-			Bucket		bucket;
 
-			/*
-			 * Fetch the item's hash key (conveniently stored in the item) and
-			 * determine which bucket it now belongs in.
-			 */
 			itup = (IndexTuple) PageGetItem(opage,
 											PageGetItemId(opage, ooffnum));
-			bucket = _hash_hashkey2bucket(_hash_get_indextuple_hashkey(itup),
-										  maxbucket, highmask, lowmask);
+			if (!HashTupleIsCopied(itup) &&
+				_hash_hashkey2bucket(_hash_get_indextuple_hashkey(itup),
+									 maxbucket, highmask, lowmask) == nbucket)
+			{
+				found = true;
+				break;
+			}
+		}
+
+		if (!found)
+		{
+			oblkno = oopaque->hasho_nextblkno;
+			_hash_relbuf(rel, obuf);
+			continue;
+		}
+
+		/*
+		 * Relock the page exclusively.  It may have changed meanwhile, but it
+		 * can't have left the bucket, since we hold the bucket lock.
+		 */
+		_hash_chgbufaccess(rel, obuf, HASH_READ, HASH_NOLOCK);
+		_hash_chgbufaccess(rel, obuf, HASH_NOLOCK, HASH_WRITE);
+		oopaque = (HashPageOpaque) PageGetSpecialPointer(opage);
 
-			if (bucket == nbucket)
+		/*
+		 * Find the end of the new bucket.  It's okay to write-lock pages of
+		 * both buckets at once, since no one else acquires buffer locks in
+		 * the new bucket while the split is copying.
+		 */
+		nbuf = _hash_getbuf(rel, start_nblkno, HASH_WRITE, LH_BUCKET_PAGE);
+		npage = BufferGetPage(nbuf);
+		nopaque = (HashPageOpaque) PageGetSpecialPointer(npage);
+		while (BlockNumberIsValid(nopaque->hasho_nextblkno))
+		{
+			BlockNumber nblkno = nopaque->hasho_nextblkno;
+
+			_hash_relbuf(rel, nbuf);
+			nbuf = _hash_getbuf(rel, nblkno, HASH_WRITE, LH_OVERFLOW_PAGE);
+			npage = BufferGetPage(nbuf);
+			nopaque = (HashPageOpaque) PageGetSpecialPointer(npage);
+		}
+		Assert(nopaque->hasho_bucket == nbucket);
+
+		/* Copy in batches, one per page of the new bucket filled */
+		omaxoffnum = PageGetMaxOffsetNumber(opage);
+		ooffnum = FirstOffsetNumber;
+		for (;;)
+		{
+			IndexTuple	itups[MaxIndexTuplesPerPage];
+			OffsetNumber offsets[MaxIndexTuplesPerPage];
+			uint16		nitups = 0;
+			Size		space_needed = 0;
+			uint16		i;
+
+			for (; ooffnum <= omaxoffnum; ooffnum = OffsetNumberNext(ooffnum))
 			{
-				/*
-				 * insert the tuple into the new bucket.  if it doesn't fit on
-				 * the current page in the new bucket, we must allocate a new
-				 * overflow page and place the tuple on that page instead.
-				 *
-				 * XXX we have a problem here if we fail to get space for a
-				 * new overflow page: we'll error out leaving the bucket split
-				 * only partially complete, meaning the index is corrupt,
-				 * since searches may fail to find entries they should find.
-				 */
-				itemsz = IndexTupleDSize(*itup);
-				itemsz = MAXALIGN(itemsz);
+				IndexTuple	itup;
+				Size		itemsz;
 
-				if (PageGetFreeSpace(npage) < itemsz)
-				{
-					/* write out nbuf and drop lock, but keep pin */
-					_hash_chgbufaccess(rel, nbuf, HASH_WRITE, HASH_NOLOCK);
-					/* chain to a new overflow page */
-					nbuf = _hash_addovflpage(rel, metabuf, nbuf);
-					npage = BufferGetPage(nbuf);
-					/* we don't need nopaque within the loop */
-				}
+				itup = (IndexTuple) PageGetItem(opage,
+												PageGetItemId(opage, ooffnum));
+				if (HashTupleIsCopied(itup) ||
+					_hash_hashkey2bucket(_hash_get_indextuple_hashkey(itup),
+										 maxbucket, highmask, lowmask) != nbucket)
+					continue;
 
-				/*
-				 * Insert tuple on new page, using _hash_pgaddtup to ensure
-				 * correct ordering by hashkey.  This is a tad inefficient
-				 * since we may have to shuffle itempointers repeatedly.
-				 * Possible future improvement: accumulate all the items for
-				 * the new page and qsort them before insertion.
-				 */
-				(void) _hash_pgaddtup(rel, nbuf, itemsz, itup);
+				itemsz = IndexTupleDSize(*itup);
+				itemsz = MAXALIGN(itemsz);
+				if (PageGetExactFreeSpace(npage) <
+					space_needed + itemsz + sizeof(ItemIdData))
+					break;
 
 				/*
-				 * Mark tuple for deletion from old page.
+				 * Copy the tuple, since the original is flagged in the same
+				 * critical section that logs the copy.
 				 */
-				deletable[ndeletable++] = ooffnum;
+				itups[nitups] = CopyIndexTuple(itup);
+				offsets[nitups] = ooffnum;
+				nitups++;
+				space_needed += itemsz + sizeof(ItemIdData);
 			}
-			else
+
+			if (nitups > 0)
 			{
+				/* each tuple is a separate rdata entry */
+				if (RelationNeedsWAL(rel))
+					XLogEnsureRecordSpace(0, 3 + nitups);
+
+				/* No ereport(ERROR) until changes are logged */
+				START_CRIT_SECTION();
+
 				/*
-				 * the tuple stays on this page, so nothing to do.
+				 * Insert the tuples on the new page, using _hash_pgaddtup to
+				 * ensure correct ordering by hashkey, and flag the originals.
 				 */
-				Assert(bucket == obucket);
+				for (i = 0; i < nitups; i++)
+				{
+					IndexTuple	itup;
+
+					(void) _hash_pgaddtup(rel, nbuf,
+										  IndexTupleDSize(*itups[i]),
+										  itups[i]);
+
+					itup = (IndexTuple) PageGetItem(opage,
+											 PageGetItemId(opage, offsets[i]));
+					itup->t_info |= HASH_COPIED_BY_SPLIT;
+				}
+
+				MarkBufferDirty(obuf);
+				MarkBufferDirty(nbuf);
+
+				/* XLOG stuff */
+				if (RelationNeedsWAL(rel))
+				{
+					xl_hash_split_copy xlrec;
+					XLogRecPtr	recptr;
+
+					xlrec.ntups = nitups;
+
+					XLogBeginInsert();
+					XLogRegisterData((char *) &xlrec, SizeOfHashSplitCopy);
+
+					XLogRegisterBuffer(0, obuf, REGBUF_STANDARD);
+					XLogRegisterBufData(0, (char *) offsets,
+										nitups * sizeof(OffsetNumber));
+
+					XLogRegisterBuffer(1, nbuf, REGBUF_STANDARD);
+					for (i = 0; i < nitups; i++)
+						XLogRegisterBufData(1, (char *) itups[i],
+											IndexTupleDSize(*itups[i]));
+
+					recptr = XLogInsert(RM_HASH_ID, XLOG_HASH_SPLIT_COPY);
+
+					PageSetLSN(opage, recptr);
+					PageSetLSN(npage, recptr);
+				}
+
+				END_CRIT_SECTION();
+
+				for (i = 0; i < nitups; i++)
+					pfree(itups[i]);
+
+				copied = true;
 			}
+
+			/* Done with this old page? */
+			if (ooffnum > omaxoffnum)
+				break;
+
+			/*
+			 * The new page is full, so chain on a new overflow page.  That
+			 * releases the current one.
+			 */
+			nbuf = _hash_addovflpage(rel, metabuf, nbuf);
+			npage = BufferGetPage(nbuf);
 		}
 
 		oblkno = oopaque->hasho_nextblkno;
+		_hash_relbuf(rel, nbuf);
+		_hash_relbuf(rel, obuf);
+
+		if (!all)
+			break;
+	}
+
+	return copied;
+}
+
+/*
+ * _hash_splitbucket_cleanup -- delete the tuples that a split copied from
+ *		'obucket', on the first page of it that still has any
+ *
+ * Returns FALSE if no page had any.
+ *
+ * The caller must hold exclusive lock on the bucket.
+ */
+static bool
+_hash_splitbucket_cleanup(Relation rel, Bucket obucket,
+						  BlockNumber start_oblkno)
+{
+	Buffer		bucketbuf;
+	Buffer		buf;
+	bool		deleted = false;
+
+	bucketbuf = _hash_getbuf(rel, start_oblkno, HASH_WRITE, LH_BUCKET_PAGE);
+	buf = bucketbuf;
+
+	for (;;)
+	{
+		Page		page = BufferGetPage(buf);
+		HashPageOpaque opaque = (HashPageOpaque) PageGetSpecialPointer(page);
+		OffsetNumber offno;
+		OffsetNumber maxoffno;
+		OffsetNumber deletable[MaxOffsetNumber];
+		int			ndeletable = 0;
+		BlockNumber blkno;
+
+		Assert(opaque->hasho_bucket == obucket);
+
+		maxoffno = PageGetMaxOffsetNumber(page);
+		for (offno = FirstOffsetNumber;
+			 offno <= maxoffno;
+			 offno = OffsetNumberNext(offno))
+		{
+			IndexTuple	itup;
+
+			itup = (IndexTuple) PageGetItem(page, PageGetItemId(page, offno));
+			if (HashTupleIsCopied(itup))
+				deletable[ndeletable++] = offno;
+		}
 
-		/*
-		 * Done scanning this old page.  If we moved any tuples, delete them
-		 * from the old page.
-		 */
 		if (ndeletable > 0)
 		{
-			PageIndexMultiDelete(opage, deletable, ndeletable);
-			_hash_wrtbuf(rel, obuf);
+			_hash_delete_items(rel, bucketbuf, buf, deletable, ndeletable);
+			deleted = true;
+			break;
 		}
-		else
-			_hash_relbuf(rel, obuf);
 
-		/* Exit loop if no more overflow pages in old bucket */
-		if (!BlockNumberIsValid(oblkno))
+		blkno = opaque->hasho_nextblkno;
+		if (!BlockNumberIsValid(blkno))
 			break;
 
-		/* Else, advance to next old page */
-		obuf = _hash_getbuf(rel, oblkno, HASH_WRITE, LH_OVERFLOW_PAGE);
-		opage = BufferGetPage(obuf);
-		oopaque = (HashPageOpaque) PageGetSpecialPointer(opage);
+		/* advance, keeping the primary bucket page pinned */
+		if (buf == bucketbuf)
+			_hash_chgbufaccess(rel, bucketbuf, HASH_READ, HASH_NOLOCK);
+		else
+			_hash_relbuf(rel, buf);
+		buf = _hash_getbuf(rel, blkno, HASH_WRITE, LH_OVERFLOW_PAGE);
 	}
 
-	/*
-	 * We're at the end of the old bucket chain, so we're done partitioning
-	 * the tuples.  Before quitting, call _hash_squeezebucket to ensure the
-	 * tuples remaining in the old bucket (including the overflow pages) are
-	 * packed as tightly as possible.  The new bucket is already tight.
-	 */
-	_hash_wrtbuf(rel, nbuf);
+	if (buf != bucketbuf)
+	{
+		_hash_relbuf(rel, buf);
+		_hash_dropbuf(rel, bucketbuf);
+	}
+	else
+		_hash_relbuf(rel, bucketbuf);
+
+	return deleted;
+}
 
-	_hash_squeezebucket(rel, obucket, start_oblkno, NULL);
+/*
+ * _hash_delete_items -- delete tuples from a page of a bucket
+ *
+ * 'buf' is the page, which the caller must hold write-locked, and
+ * 'bucketbuf' the bucket's primary page, which the caller must hold pinned
+ * (it may be the same buffer).  The latter is logged with the deletion so
+ * that replay takes a cleanup lock on it, which is what keeps Hot Standby
+ * scans of the bucket from seeing tuples vanish under them (see README).
+ */
+void
+_hash_delete_items(Relation rel, Buffer bucketbuf, Buffer buf,
+				   OffsetNumber *deletable, int ndeletable)
+{
+	Page		page = BufferGetPage(buf);
+	bool		is_primary_bucket_page = (buf == bucketbuf);
+
+	/* No ereport(ERROR) until changes are logged */
+	START_CRIT_SECTION();
+
+	PageIndexMultiDelete(page, deletable, ndeletable);
+	MarkBufferDirty(buf);
+
+	/* XLOG stuff */
+	if (RelationNeedsWAL(rel))
+	{
+		xl_hash_delete xlrec;
+		XLogRecPtr	recptr;
+
+		xlrec.is_primary_bucket_page = is_primary_bucket_page;
+
+		XLogBeginInsert();
+		XLogRegisterData((char *) &xlrec, SizeOfHashDelete);
+
+		if (is_primary_bucket_page)
+		{
+			XLogRegisterBuffer(0, buf, REGBUF_STANDARD);
+			XLogRegisterBufData(0, (char *) deletable,
+								ndeletable * sizeof(OffsetNumber));
+		}
+		else
+		{
+			XLogRegisterBuffer(0, bucketbuf, REGBUF_NO_IMAGE | REGBUF_STANDARD);
+			XLogRegisterBuffer(1, buf, REGBUF_STANDARD);
+			XLogRegisterBufData(1, (char *) deletable,
+								ndeletable * sizeof(OffsetNumber));
+		}
+
+		recptr = XLogInsert(RM_HASH_ID, XLOG_HASH_DELETE);
+
+		PageSetLSN(page, recptr);
+	}
+
+	END_CRIT_SECTION();
 }
@@ -198,10 +198,7 @@ _hash_first(IndexScanDesc scan, ScanDirection dir)
 		/*
 		 * Compute the target bucket number, and convert to block number.
 		 */
-		bucket = _hash_hashkey2bucket(hashkey,
-									  metap->hashm_maxbucket,
-									  metap->hashm_highmask,
-									  metap->hashm_lowmask);
+		bucket = _hash_getbucket(metap, hashkey);
 
 		blkno = BUCKET_TO_BLKNO(metap, bucket);
 
@@ -244,6 +241,10 @@ _hash_first(IndexScanDesc scan, ScanDirection dir)
 	opaque = (HashPageOpaque) PageGetSpecialPointer(page);
 	Assert(opaque->hasho_bucket == bucket);
 
+	/* and keep an extra pin on it for as long as we hold the bucket lock */
+	IncrBufferRefCount(buf);
+	so->hashso_bucket_buf = buf;
+
 	/* If a backwards scan is requested, move to the end of the chain */
 	if (ScanDirectionIsBackward(dir))
 	{
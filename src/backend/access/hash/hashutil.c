@@ -131,6 +131,32 @@ _hash_hashkey2bucket(uint32 hashkey, uint32 maxbucket,
 	return bucket;
 }
 
+/*
+ * _hash_getbucket -- determine which bucket to search or insert into for
+ *		the hashkey, given the current metapage contents.
+ *
+ * This differs from _hash_hashkey2bucket only while the split that created
+ * the last bucket is still copying tuples into it: keys belonging to that
+ * bucket are then still looked for, and added, in the bucket it was split
+ * from.  The caller must hold at least share lock on the metapage.
+ */
+Bucket
+_hash_getbucket(HashMetaPage metap, uint32 hashkey)
+{
+	Bucket		bucket;
+
+	bucket = _hash_hashkey2bucket(hashkey,
+								  metap->hashm_maxbucket,
+								  metap->hashm_highmask,
+								  metap->hashm_lowmask);
+
+	if (metap->hashm_splitstate == HASH_SPLIT_COPYING &&
+		bucket == metap->hashm_maxbucket)
+		bucket &= metap->hashm_lowmask;
+
+	return bucket;
+}
+
 /*
  * _hash_log2 -- returns ceil(lg2(num))
  */
@@ -0,0 +1,359 @@
+/*-------------------------------------------------------------------------
+ *
+ * hashxlog.c
+ *	  WAL replay logic for hash indexes.
+ *
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * IDENTIFICATION
+ *	  src/backend/access/hash/hashxlog.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/hash.h"
+#include "access/xlog.h"
+#include "access/xlogutils.h"
+
+
+/*
+ * hash_xlog_addtuples -- add tuples to a bucket page in hashkey order
+ *
+ * 'data' holds 'ntups' index tuples, one after another.  They are added one
+ * at a time at the position _hash_binsearch() picks, just like
+ * _hash_pgaddtup() did when the record was made, so that the page ends up
+ * with the same item offsets as it had.
+ */
+static void
+hash_xlog_addtuples(Page page, char *data, Size len, int ntups)
+{
+	char	   *end PG_USED_FOR_ASSERTS_ONLY = data + len;
+	int			i;
+
+	for (i = 0; i < ntups; i++)
+	{
+		IndexTuple	itup = (IndexTuple) data;
+		Size		itemsz = IndexTupleDSize(*itup);
+		OffsetNumber off;
+
+		Assert(data + itemsz <= end);
+
+		off = _hash_binsearch(page, _hash_get_indextuple_hashkey(itup));
+		if (PageAddItem(page, (Item) itup, itemsz, off,
+						false, false) == InvalidOffsetNumber)
+			elog(PANIC, "hash_xlog_addtuples: failed to add item");
+
+		data += itemsz;
+	}
+	Assert(data == end);
+}
+
+/*
+ * Replay a record that consists only of full page images: restore them all,
+ * holding on to every buffer until the last one is done so that Hot Standby
+ * never sees the bucket chain, bitmap and metapage out of step.  If
+ * 'cleanup' is true, a cleanup lock is taken on block 0, the primary bucket
+ * page, which may or may not have an image.
+ */
+static void
+hash_xlog_restore_images(XLogReaderState *record, bool cleanup)
+{
+	Buffer		buffers[XLR_MAX_BLOCK_ID + 1];
+	int			block_id;
+
+	for (block_id = 0; block_id <= record->max_block_id; block_id++)
+	{
+		buffers[block_id] = InvalidBuffer;
+		if (!XLogRecHasBlockRef(record, block_id))
+			continue;
+
+		(void) XLogReadBufferForRedoExtended(record, block_id, RBM_NORMAL,
+											 cleanup && block_id == 0,
+											 &buffers[block_id]);
+	}
+
+	for (block_id = 0; block_id <= record->max_block_id; block_id++)
+	{
+		if (BufferIsValid(buffers[block_id]))
+			UnlockReleaseBuffer(buffers[block_id]);
+	}
+}
+
+static void
+hash_xlog_insert(XLogReaderState *record)
+{
+	XLogRecPtr	lsn = record->EndRecPtr;
+	xl_hash_insert *xlrec = (xl_hash_insert *) XLogRecGetData(record);
+	Buffer		buffer;
+	Buffer		metabuf;
+	Page		page;
+
+	if (XLogReadBufferForRedo(record, 0, &buffer) == BLK_NEEDS_REDO)
+	{
+		Size		datalen;
+		char	   *datapos = XLogRecGetBlockData(record, 0, &datalen);
+
+		page = BufferGetPage(buffer);
+
+		if (PageAddItem(page, (Item) datapos, datalen, xlrec->offnum,
+						false, false) == InvalidOffsetNumber)
+			elog(PANIC, "hash_xlog_insert: failed to add item");
+
+		PageSetLSN(page, lsn);
+		MarkBufferDirty(buffer);
+	}
+
+	if (XLogReadBufferForRedo(record, 1, &metabuf) == BLK_NEEDS_REDO)
+	{
+		HashMetaPage metap;
+
+		page = BufferGetPage(metabuf);
+		metap = HashPageGetMeta(page);
+		metap->hashm_ntuples += 1;
+
+		PageSetLSN(page, lsn);
+		MarkBufferDirty(metabuf);
+	}
+
+	if (BufferIsValid(buffer))
+		UnlockReleaseBuffer(buffer);
+	if (BufferIsValid(metabuf))
+		UnlockReleaseBuffer(metabuf);
+}
+
+static void
+hash_xlog_split_copy(XLogReaderState *record)
+{
+	XLogRecPtr	lsn = record->EndRecPtr;
+	xl_hash_split_copy *xlrec = (xl_hash_split_copy *) XLogRecGetData(record);
+	Buffer		obuf;
+	Buffer		nbuf;
+	Page		page;
+
+	/* flag the originals in the old bucket */
+	if (XLogReadBufferForRedo(record, 0, &obuf) == BLK_NEEDS_REDO)
+	{
+		OffsetNumber *offsets;
+		Size		len;
+		int			i;
+
+		offsets = (OffsetNumber *) XLogRecGetBlockData(record, 0, &len);
+		Assert(len == xlrec->ntups * sizeof(OffsetNumber));
+
+		page = BufferGetPage(obuf);
+		for (i = 0; i < xlrec->ntups; i++)
+		{
+			IndexTuple	itup;
+
+			itup = (IndexTuple) PageGetItem(page,
+											PageGetItemId(page, offsets[i]));
+			itup->t_info |= HASH_COPIED_BY_SPLIT;
+		}
+
+		PageSetLSN(page, lsn);
+		MarkBufferDirty(obuf);
+	}
+
+	/* and add the copies to the new bucket */
+	if (XLogReadBufferForRedo(record, 1, &nbuf) == BLK_NEEDS_REDO)
+	{
+		char	   *data;
+		Size		len;
+
+		data = XLogRecGetBlockData(record, 1, &len);
+
+		page = BufferGetPage(nbuf);
+		hash_xlog_addtuples(page, data, len, xlrec->ntups);
+
+		PageSetLSN(page, lsn);
+		MarkBufferDirty(nbuf);
+	}
+
+	if (BufferIsValid(obuf))
+		UnlockReleaseBuffer(obuf);
+	if (BufferIsValid(nbuf))
+		UnlockReleaseBuffer(nbuf);
+}
+
+static void
+hash_xlog_split_state(XLogReaderState *record)
+{
+	XLogRecPtr	lsn = record->EndRecPtr;
+	xl_hash_split_state *xlrec = (xl_hash_split_state *) XLogRecGetData(record);
+	Buffer		metabuf;
+
+	if (XLogReadBufferForRedo(record, 0, &metabuf) == BLK_NEEDS_REDO)
+	{
+		Page		page = BufferGetPage(metabuf);
+		HashMetaPage metap = HashPageGetMeta(page);
+
+		metap->hashm_splitstate = xlrec->splitstate;
+
+		PageSetLSN(page, lsn);
+		MarkBufferDirty(metabuf);
+	}
+	if (BufferIsValid(metabuf))
+		UnlockReleaseBuffer(metabuf);
+}
+
+static void
+hash_xlog_move_page_contents(XLogReaderState *record)
+{
+	XLogRecPtr	lsn = record->EndRecPtr;
+	xl_hash_move_page_contents *xlrec = (xl_hash_move_page_contents *) XLogRecGetData(record);
+	Buffer		bucketbuf = InvalidBuffer;
+	Buffer		writebuf;
+	Buffer		deletebuf;
+	Page		page;
+
+	/*
+	 * Make sure no Hot Standby scan is in the bucket, by taking a cleanup
+	 * lock on its primary page (see README).  There's nothing to change on
+	 * it unless it's also the page written to.
+	 */
+	if (!xlrec->is_prim_bucket_same_wrt)
+		(void) XLogReadBufferForRedoExtended(record, 0, RBM_NORMAL, true,
+											 &bucketbuf);
+
+	if (XLogReadBufferForRedoExtended(record, 1, RBM_NORMAL,
+									  xlrec->is_prim_bucket_same_wrt,
+									  &writebuf) == BLK_NEEDS_REDO)
+	{
+		char	   *data;
+		Size		len;
+
+		data = XLogRecGetBlockData(record, 1, &len);
+
+		page = BufferGetPage(writebuf);
+		hash_xlog_addtuples(page, data, len, xlrec->ntups);
+
+		PageSetLSN(page, lsn);
+		MarkBufferDirty(writebuf);
+	}
+
+	if (XLogReadBufferForRedo(record, 2, &deletebuf) == BLK_NEEDS_REDO)
+	{
+		OffsetNumber *offsets;
+		Size		len;
+
+		offsets = (OffsetNumber *) XLogRecGetBlockData(record, 2, &len);
+		Assert(len == xlrec->ntups * sizeof(OffsetNumber));
+
+		page = BufferGetPage(deletebuf);
+		PageIndexMultiDelete(page, offsets, xlrec->ntups);
+
+		PageSetLSN(page, lsn);
+		MarkBufferDirty(deletebuf);
+	}
+
+	if (BufferIsValid(deletebuf))
+		UnlockReleaseBuffer(deletebuf);
+	if (BufferIsValid(writebuf))
+		UnlockReleaseBuffer(writebuf);
+	if (BufferIsValid(bucketbuf))
+		UnlockReleaseBuffer(bucketbuf);
+}
+
+static void
+hash_xlog_delete(XLogReaderState *record)
+{
+	XLogRecPtr	lsn = record->EndRecPtr;
+	xl_hash_delete *xlrec = (xl_hash_delete *) XLogRecGetData(record);
+	Buffer		bucketbuf;
+	Buffer		deletebuf = InvalidBuffer;
+	uint8		block_id;
+	XLogRedoAction action;
+
+	/* as for a move, first get a cleanup lock on the primary bucket page */
+	action = XLogReadBufferForRedoExtended(record, 0, RBM_NORMAL, true,
+										   &bucketbuf);
+	if (xlrec->is_primary_bucket_page)
+	{
+		block_id = 0;
+		deletebuf = bucketbuf;
+	}
+	else
+	{
+		block_id = 1;
+		action = XLogReadBufferForRedo(record, 1, &deletebuf);
+	}
+
+	if (action == BLK_NEEDS_REDO)
+	{
+		Page		page = BufferGetPage(deletebuf);
+		OffsetNumber *offsets;
+		Size		len;
+
+		offsets = (OffsetNumber *) XLogRecGetBlockData(record, block_id, &len);
+		PageIndexMultiDelete(page, offsets, len / sizeof(OffsetNumber));
+
+		PageSetLSN(page, lsn);
+		MarkBufferDirty(deletebuf);
+	}
+
+	if (!xlrec->is_primary_bucket_page && BufferIsValid(deletebuf))
+		UnlockReleaseBuffer(deletebuf);
+	if (BufferIsValid(bucketbuf))
+		UnlockReleaseBuffer(bucketbuf);
+}
+
+static void
+hash_xlog_update_meta_page(XLogReaderState *record)
+{
+	XLogRecPtr	lsn = record->EndRecPtr;
+	xl_hash_update_meta_page *xlrec = (xl_hash_update_meta_page *) XLogRecGetData(record);
+	Buffer		metabuf;
+
+	if (XLogReadBufferForRedo(record, 0, &metabuf) == BLK_NEEDS_REDO)
+	{
+		Page		page = BufferGetPage(metabuf);
+		HashMetaPage metap = HashPageGetMeta(page);
+
+		metap->hashm_ntuples = xlrec->ntuples;
+
+		PageSetLSN(page, lsn);
+		MarkBufferDirty(metabuf);
+	}
+	if (BufferIsValid(metabuf))
+		UnlockReleaseBuffer(metabuf);
+}
+
+void
+hash_redo(XLogReaderState *record)
+{
+	uint8		info = XLogRecGetInfo(record) & ~XLR_INFO_MASK;
+
+	switch (info)
+	{
+		case XLOG_HASH_INSERT:
+			hash_xlog_insert(record);
+			break;
+		case XLOG_HASH_ADD_OVFL_PAGE:
+		case XLOG_HASH_SPLIT_ALLOCATE:
+			hash_xlog_restore_images(record, false);
+			break;
+		case XLOG_HASH_FREE_OVFL_PAGE:
+			hash_xlog_restore_images(record, true);
+			break;
+		case XLOG_HASH_SPLIT_COPY:
+			hash_xlog_split_copy(record);
+			break;
+		case XLOG_HASH_SPLIT_STATE:
+			hash_xlog_split_state(record);
+			break;
+		case XLOG_HASH_MOVE_PAGE_CONTENTS:
+			hash_xlog_move_page_contents(record);
+			break;
+		case XLOG_HASH_DELETE:
+			hash_xlog_delete(record);
+			break;
+		case XLOG_HASH_UPDATE_META_PAGE:
+			hash_xlog_update_meta_page(record);
+			break;
+		default:
+			elog(PANIC, "hash_redo: unknown op code %u", info);
+	}
+}
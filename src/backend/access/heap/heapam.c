@@ -82,7 +82,11 @@ static HeapScanDesc heap_beginscan_internal(Relation relation,
 						int nkeys, ScanKey key,
 					  bool allow_strat, bool allow_sync, bool allow_pagemode,
 						bool is_bitmapscan, bool is_samplescan,
-						bool temp_snap);
+						bool temp_snap, ParallelHeapScanDesc parallel_scan);
+static BlockNumber heap_parallelscan_nextpage(HeapScanDesc scan);
+static void heap_prefetch_ahead(HeapScanDesc scan, BlockNumber page);
+static Buffer heap_read_page(HeapScanDesc scan, BlockNumber page);
+static void heap_release_readahead(HeapScanDesc scan);
 static HeapTuple heap_prepare_insert(Relation relation, HeapTuple tup,
 					TransactionId xid, CommandId cid, int options);
 static XLogRecPtr log_heap_update(Relation reln, Buffer oldbuf,
@@ -223,7 +227,10 @@ initscan(HeapScanDesc scan, ScanKey key, bool is_rescan)
 	 * results for a non-MVCC snapshot, the caller must hold some higher-level
 	 * lock that ensures the interesting tuple(s) won't change.)
 	 */
-	scan->rs_nblocks = RelationGetNumberOfBlocks(scan->rs_rd);
+	if (scan->rs_parallel != NULL)
+		scan->rs_nblocks = scan->rs_parallel->phs_nblocks;
+	else
+		scan->rs_nblocks = RelationGetNumberOfBlocks(scan->rs_rd);
 
 	/*
 	 * If the table is large relative to NBuffers, use a bulk-read access
@@ -245,6 +252,13 @@ initscan(HeapScanDesc scan, ScanKey key, bool is_rescan)
 	else
 		allow_strat = allow_sync = false;
 
+	/*
+	 * In a parallel scan, the leader has already decided whether to use
+	 * syncscan and where to start, and every participant must agree.
+	 */
+	if (scan->rs_parallel != NULL)
+		allow_sync = scan->rs_parallel->phs_syncscan;
+
 	if (allow_strat)
 	{
 		if (scan->rs_strategy == NULL)
@@ -257,7 +271,13 @@ initscan(HeapScanDesc scan, ScanKey key, bool is_rescan)
 		scan->rs_strategy = NULL;
 	}
 
-	if (is_rescan)
+	if (scan->rs_parallel != NULL)
+	{
+		/* For parallel scans, the shared state dictates the start block. */
+		scan->rs_syncscan = allow_sync;
+		scan->rs_startblock = scan->rs_parallel->phs_startblock;
+	}
+	else if (is_rescan)
 	{
 		/*
 		 * If rescan, keep the previous startblock setting so that rewinding a
@@ -284,6 +304,9 @@ initscan(HeapScanDesc scan, ScanKey key, bool is_rescan)
 	ItemPointerSetInvalid(&scan->rs_ctup.t_self);
 	scan->rs_cbuf = InvalidBuffer;
 	scan->rs_cblock = InvalidBlockNumber;
+	scan->rs_prefetch_next = 0;
+	scan->rs_prefetch_target = 0;
+	Assert(scan->rs_nrabufs == 0);
 
 	/* page-at-a-time fields are always invalid when not rs_inited */
 
@@ -308,6 +331,158 @@ heap_setscanlimits(HeapScanDesc scan, BlockNumber startBlk, BlockNumber numBlks)
 	scan->rs_startblock = startBlk;
 	scan->rs_initblock = startBlk;
 	scan->rs_numblocks = numBlks;
+	scan->rs_prefetch_next = 0;
+}
+
+/*
+ * heap_prefetch_ahead - issue read-ahead for a sequential scan
+ *
+ * Called by heapgetpage before it reads "page".  We try to keep
+ * rs_prefetch_target pages beyond the current one in flight, using
+ * PrefetchBuffer, so that on storage that can serve many requests at once
+ * the reads of the following pages overlap with processing of this one.
+ * The kernel's own read-ahead only helps with the simplest case of a single
+ * scan reading a local file from the start; a synchronized scan starting in
+ * the middle of a table, or network storage with high latency, needs us to
+ * ask for the blocks explicitly.
+ *
+ * As in a bitmap heap scan, the distance starts small and ramps up to
+ * target_prefetch_pages, so that a scan that's stopped early by a LIMIT
+ * doesn't issue a burst of useless I/O.  Pages are counted from
+ * rs_startblock so that wraparound of a synchronized scan is handled, and
+ * we never prefetch past the last page the scan will read.
+ *
+ * We only bother for tables big enough to be read with a bulk-read
+ * strategy; smaller ones are likely to be cached already, and probing the
+ * buffer mapping table for every page isn't free.
+ *
+ * Parallel scans hand out pages one at a time through shared memory, so
+ * there's no telling which pages this backend will read next; and sample
+ * scans skip around according to the sampling method.  We don't prefetch
+ * for either.
+ */
+static void
+heap_prefetch_ahead(HeapScanDesc scan, BlockNumber page)
+{
+#ifdef USE_PREFETCH
+	BlockNumber nblocks = scan->rs_nblocks;
+	BlockNumber total;
+	BlockNumber cur;
+
+	if (target_prefetch_pages <= 0 || scan->rs_strategy == NULL ||
+		scan->rs_parallel != NULL || scan->rs_samplescan)
+		return;
+
+	total = nblocks;
+	if (scan->rs_numblocks != InvalidBlockNumber && scan->rs_numblocks < total)
+		total = scan->rs_numblocks;
+
+	/* position of this page, counting from the start of the scan */
+	cur = (page + nblocks - scan->rs_startblock) % nblocks;
+	if (scan->rs_prefetch_next <= cur)
+		scan->rs_prefetch_next = cur + 1;
+
+	/* ramp up the read-ahead distance */
+	if (scan->rs_prefetch_target < target_prefetch_pages)
+	{
+		if (scan->rs_prefetch_target == 0)
+			scan->rs_prefetch_target = 1;
+		else if (scan->rs_prefetch_target >= target_prefetch_pages / 2)
+			scan->rs_prefetch_target = target_prefetch_pages;
+		else
+			scan->rs_prefetch_target *= 2;
+	}
+
+	while (scan->rs_prefetch_next < total &&
+		   scan->rs_prefetch_next <= cur + scan->rs_prefetch_target)
+	{
+		BlockNumber blkno;
+
+		blkno = (scan->rs_startblock + scan->rs_prefetch_next) % nblocks;
+		PrefetchBuffer(scan->rs_rd, MAIN_FORKNUM, blkno);
+		scan->rs_prefetch_next++;
+	}
+#endif   /* USE_PREFETCH */
+}
+
+/*
+ * heap_read_page - read a page for heapgetpage
+ *
+ * A forward sequential scan of a large table reads its pages in runs of up
+ * to io_combine_limit consecutive blocks with ReadBuffersExtended, which
+ * needs just one system call for the blocks of the run that aren't in shared
+ * buffers already.  The remaining pages of the run stay pinned in rs_rabufs
+ * until the scan asks for them, or until we find it has gone elsewhere
+ * (backwards, or to a restored mark), in which case they are released.
+ *
+ * A run goes no further than the end of the relation or the end of the
+ * scan, whichever comes first, so a synchronized scan that wraps around
+ * starts a new run at block 0.  As for read-ahead, we don't do this for
+ * parallel scans, sample scans, or small tables.
+ */
+static Buffer
+heap_read_page(HeapScanDesc scan, BlockNumber page)
+{
+	BlockNumber nblocks = scan->rs_nblocks;
+	BlockNumber total;
+	BlockNumber remaining;
+	int			nread;
+
+	if (scan->rs_nrabufs > 0)
+	{
+		if (page == scan->rs_rablock)
+		{
+			Buffer		buf = scan->rs_rabufs[scan->rs_rabufnext++];
+
+			scan->rs_rablock++;
+			if (scan->rs_rabufnext >= scan->rs_nrabufs)
+				scan->rs_nrabufs = scan->rs_rabufnext = 0;
+			return buf;
+		}
+		heap_release_readahead(scan);
+	}
+
+	/* only start a run if we're moving forward */
+	if (io_combine_limit <= 1 || scan->rs_strategy == NULL ||
+		scan->rs_parallel != NULL || scan->rs_samplescan ||
+		(scan->rs_cblock != InvalidBlockNumber &&
+		 page != (scan->rs_cblock + 1) % nblocks))
+		return ReadBufferExtended(scan->rs_rd, MAIN_FORKNUM, page,
+								  RBM_NORMAL, scan->rs_strategy);
+
+	total = nblocks;
+	if (scan->rs_numblocks != InvalidBlockNumber && scan->rs_numblocks < total)
+		total = scan->rs_numblocks;
+	remaining = total - (page + nblocks - scan->rs_startblock) % nblocks;
+	remaining = Min(remaining, nblocks - page);
+	nread = (int) Min(remaining, (BlockNumber) io_combine_limit);
+
+	if (nread <= 1)
+		return ReadBufferExtended(scan->rs_rd, MAIN_FORKNUM, page,
+								  RBM_NORMAL, scan->rs_strategy);
+
+	if (scan->rs_rabufs == NULL)
+		scan->rs_rabufs = (Buffer *)
+			palloc(MAX_IO_COMBINE_BLOCKS * sizeof(Buffer));
+
+	ReadBuffersExtended(scan->rs_rd, MAIN_FORKNUM, page, nread,
+						scan->rs_strategy, scan->rs_rabufs);
+	scan->rs_nrabufs = nread;
+	scan->rs_rabufnext = 1;
+	scan->rs_rablock = page + 1;
+
+	return scan->rs_rabufs[0];
+}
+
+/*
+ * heap_release_readahead - unpin the pages of a combined read not yet used
+ */
+static void
+heap_release_readahead(HeapScanDesc scan)
+{
+	while (scan->rs_rabufnext < scan->rs_nrabufs)
+		ReleaseBuffer(scan->rs_rabufs[scan->rs_rabufnext++]);
+	scan->rs_nrabufs = scan->rs_rabufnext = 0;
 }
 
 /*
@@ -345,9 +520,11 @@ heapgetpage(HeapScanDesc scan, BlockNumber page)
 	 */
 	CHECK_FOR_INTERRUPTS();
 
+	/* keep the pages we'll want next on their way in */
+	heap_prefetch_ahead(scan, page);
+
 	/* read page using selected strategy */
-	scan->rs_cbuf = ReadBufferExtended(scan->rs_rd, MAIN_FORKNUM, page,
-									   RBM_NORMAL, scan->rs_strategy);
+	scan->rs_cbuf = heap_read_page(scan, page);
 	scan->rs_cblock = page;
 
 	if (!scan->rs_pageatatime)
@@ -483,7 +660,20 @@ heapgettup(HeapScanDesc scan,
 				tuple->t_data = NULL;
 				return;
 			}
-			page = scan->rs_startblock; /* first page */
+			if (scan->rs_parallel != NULL)
+			{
+				page = heap_parallelscan_nextpage(scan);
+
+				/* Other processes might have already finished the scan. */
+				if (page == InvalidBlockNumber)
+				{
+					Assert(!BufferIsValid(scan->rs_cbuf));
+					tuple->t_data = NULL;
+					return;
+				}
+			}
+			else
+				page = scan->rs_startblock;		/* first page */
 			heapgetpage(scan, page);
 			lineoff = FirstOffsetNumber;		/* first offnum */
 			scan->rs_inited = true;
@@ -518,6 +708,9 @@ heapgettup(HeapScanDesc scan,
 				return;
 			}
 
+			/* backward parallel scan not supported */
+			Assert(scan->rs_parallel == NULL);
+
 			/*
 			 * Disable reporting to syncscan logic in a backwards scan; it's
 			 * not very likely anyone else is doing the same thing at the same
@@ -656,6 +849,11 @@ heapgettup(HeapScanDesc scan,
 				page = scan->rs_nblocks;
 			page--;
 		}
+		else if (scan->rs_parallel != NULL)
+		{
+			page = heap_parallelscan_nextpage(scan);
+			finished = (page == InvalidBlockNumber);
+		}
 		else
 		{
 			page++;
@@ -760,7 +958,20 @@ heapgettup_pagemode(HeapScanDesc scan,
 				tuple->t_data = NULL;
 				return;
 			}
-			page = scan->rs_startblock; /* first page */
+			if (scan->rs_parallel != NULL)
+			{
+				page = heap_parallelscan_nextpage(scan);
+
+				/* Other processes might have already finished the scan. */
+				if (page == InvalidBlockNumber)
+				{
+					Assert(!BufferIsValid(scan->rs_cbuf));
+					tuple->t_data = NULL;
+					return;
+				}
+			}
+			else
+				page = scan->rs_startblock;		/* first page */
 			heapgetpage(scan, page);
 			lineindex = 0;
 			scan->rs_inited = true;
@@ -792,6 +1003,9 @@ heapgettup_pagemode(HeapScanDesc scan,
 				return;
 			}
 
+			/* backward parallel scan not supported */
+			Assert(scan->rs_parallel == NULL);
+
 			/*
 			 * Disable reporting to syncscan logic in a backwards scan; it's
 			 * not very likely anyone else is doing the same thing at the same
@@ -919,6 +1133,11 @@ heapgettup_pagemode(HeapScanDesc scan,
 				page = scan->rs_nblocks;
 			page--;
 		}
+		else if (scan->rs_parallel != NULL)
+		{
+			page = heap_parallelscan_nextpage(scan);
+			finished = (page == InvalidBlockNumber);
+		}
 		else
 		{
 			page++;
@@ -1322,7 +1541,8 @@ heap_beginscan(Relation relation, Snapshot snapshot,
 			   int nkeys, ScanKey key)
 {
 	return heap_beginscan_internal(relation, snapshot, nkeys, key,
-								   true, true, true, false, false, false);
+								   true, true, true, false, false, false,
+								   NULL);
 }
 
 HeapScanDesc
@@ -1332,7 +1552,8 @@ heap_beginscan_catalog(Relation relation, int nkeys, ScanKey key)
 	Snapshot	snapshot = RegisterSnapshot(GetCatalogSnapshot(relid));
 
 	return heap_beginscan_internal(relation, snapshot, nkeys, key,
-								   true, true, true, false, false, true);
+								   true, true, true, false, false, true,
+								   NULL);
 }
 
 HeapScanDesc
@@ -1342,7 +1563,7 @@ heap_beginscan_strat(Relation relation, Snapshot snapshot,
 {
 	return heap_beginscan_internal(relation, snapshot, nkeys, key,
 								   allow_strat, allow_sync, true,
-								   false, false, false);
+								   false, false, false, NULL);
 }
 
 HeapScanDesc
@@ -1350,7 +1571,8 @@ heap_beginscan_bm(Relation relation, Snapshot snapshot,
 				  int nkeys, ScanKey key)
 {
 	return heap_beginscan_internal(relation, snapshot, nkeys, key,
-								   false, false, true, true, false, false);
+								   false, false, true, true, false, false,
+								   NULL);
 }
 
 HeapScanDesc
@@ -1360,14 +1582,15 @@ heap_beginscan_sampling(Relation relation, Snapshot snapshot,
 {
 	return heap_beginscan_internal(relation, snapshot, nkeys, key,
 								   allow_strat, false, allow_pagemode,
-								   false, true, false);
+								   false, true, false, NULL);
 }
 
 static HeapScanDesc
 heap_beginscan_internal(Relation relation, Snapshot snapshot,
 						int nkeys, ScanKey key,
 					  bool allow_strat, bool allow_sync, bool allow_pagemode,
-					  bool is_bitmapscan, bool is_samplescan, bool temp_snap)
+					  bool is_bitmapscan, bool is_samplescan, bool temp_snap,
+						ParallelHeapScanDesc parallel_scan)
 {
 	HeapScanDesc scan;
 
@@ -1394,6 +1617,10 @@ heap_beginscan_internal(Relation relation, Snapshot snapshot,
 	scan->rs_allow_strat = allow_strat;
 	scan->rs_allow_sync = allow_sync;
 	scan->rs_temp_snap = temp_snap;
+	scan->rs_parallel = parallel_scan;
+	scan->rs_rabufs = NULL;
+	scan->rs_nrabufs = 0;
+	scan->rs_rabufnext = 0;
 
 	/*
 	 * we can use page-at-a-time mode if it's an MVCC-safe snapshot
@@ -1444,6 +1671,7 @@ heap_rescan(HeapScanDesc scan,
 	 */
 	if (BufferIsValid(scan->rs_cbuf))
 		ReleaseBuffer(scan->rs_cbuf);
+	heap_release_readahead(scan);
 
 	/*
 	 * reinitialize scan descriptor
@@ -1468,6 +1696,7 @@ heap_endscan(HeapScanDesc scan)
 	 */
 	if (BufferIsValid(scan->rs_cbuf))
 		ReleaseBuffer(scan->rs_cbuf);
+	heap_release_readahead(scan);
 
 	/*
 	 * decrement relation reference count and free scan descriptor storage
@@ -1483,9 +1712,122 @@ heap_endscan(HeapScanDesc scan)
 	if (scan->rs_temp_snap)
 		UnregisterSnapshot(scan->rs_snapshot);
 
+	if (scan->rs_rabufs)
+		pfree(scan->rs_rabufs);
+
 	pfree(scan);
 }
 
+/* ----------------
+ *		heap_parallelscan_estimate - estimate storage for ParallelHeapScanDesc
+ *
+ *		Participants use the snapshot of the query they're running, which
+ *		parallel.c has already synchronized, so this is a constant for now.
+ * ----------------
+ */
+Size
+heap_parallelscan_estimate(void)
+{
+	return sizeof(ParallelHeapScanDescData);
+}
+
+/* ----------------
+ *		heap_parallelscan_initialize - initialize ParallelHeapScanDesc
+ *
+ *		Must allow as many bytes of shared memory as returned by
+ *		heap_parallelscan_estimate.  Call this just once in the leader
+ *		process; then, individual workers attach via heap_beginscan_parallel.
+ * ----------------
+ */
+void
+heap_parallelscan_initialize(ParallelHeapScanDesc target, Relation relation)
+{
+	target->phs_relid = RelationGetRelid(relation);
+	target->phs_nblocks = RelationGetNumberOfBlocks(relation);
+
+	/*
+	 * Use a synchronized scan on large tables, same as initscan() does for
+	 * the non-parallel case; but decide once, here, so that every
+	 * participant starts from the same block.
+	 */
+	target->phs_syncscan = synchronize_seqscans &&
+		!RelationUsesLocalBuffers(relation) &&
+		target->phs_nblocks > NBuffers / 4;
+	if (target->phs_syncscan)
+		target->phs_startblock = ss_get_location(relation,
+												 target->phs_nblocks);
+	else
+		target->phs_startblock = 0;
+	pg_atomic_init_u32(&target->phs_nallocated, 0);
+}
+
+/* ----------------
+ *		heap_beginscan_parallel - join a parallel scan
+ *
+ *		Caller must hold a suitable lock on the correct relation.
+ * ----------------
+ */
+HeapScanDesc
+heap_beginscan_parallel(Relation relation, Snapshot snapshot,
+						ParallelHeapScanDesc parallel_scan)
+{
+	Assert(RelationGetRelid(relation) == parallel_scan->phs_relid);
+
+	return heap_beginscan_internal(relation, snapshot, 0, NULL,
+								   true, true, true, false, false, false,
+								   parallel_scan);
+}
+
+/* ----------------
+ *		heap_parallelscan_nextpage - get the next page to scan
+ *
+ *		Get the next page to scan.  Even if there are no pages left to scan,
+ *		another backend could have grabbed a page to scan and not yet finished
+ *		looking at it, so it doesn't follow that the scan is done when the
+ *		first backend gets an InvalidBlockNumber return.
+ * ----------------
+ */
+static BlockNumber
+heap_parallelscan_nextpage(HeapScanDesc scan)
+{
+	ParallelHeapScanDesc parallel_scan = scan->rs_parallel;
+	uint32		nallocated;
+	BlockNumber page;
+
+	Assert(parallel_scan != NULL);
+
+	/*
+	 * Claim the next block with an atomic increment, so that no lock is
+	 * needed.  The counter runs past phs_nblocks once the scan is done,
+	 * since every participant increments it one last time before noticing;
+	 * that can only overflow for relations within a few blocks of the
+	 * maximum BlockNumber, which we don't worry about.
+	 */
+	nallocated = pg_atomic_fetch_add_u32(&parallel_scan->phs_nallocated, 1);
+	if (nallocated >= parallel_scan->phs_nblocks)
+		return InvalidBlockNumber;
+
+	page = (parallel_scan->phs_startblock + nallocated) %
+		parallel_scan->phs_nblocks;
+
+	/*
+	 * Report scan location.  Normally, we report the current page number.
+	 * When we reach the end of the scan, though, we report the starting page,
+	 * not the ending page, just so the starting positions for later scans
+	 * doesn't slew backwards.  We only report the position at the end of the
+	 * scan once, though: subsequent callers will report nothing.
+	 */
+	if (scan->rs_syncscan)
+	{
+		if (nallocated + 1 < parallel_scan->phs_nblocks)
+			ss_report_location(scan->rs_rd, page);
+		else
+			ss_report_location(scan->rs_rd, parallel_scan->phs_startblock);
+	}
+
+	return page;
+}
+
 /* ----------------
  *		heap_getnext	- retrieve next tuple in scan
  *
@@ -2150,7 +2492,7 @@ heap_insert(Relation relation, HeapTuple tup, CommandId cid,
 		PageClearAllVisible(BufferGetPage(buffer));
 		visibilitymap_clear(relation,
 							ItemPointerGetBlockNumber(&(heaptup->t_self)),
-							vmbuffer);
+							vmbuffer, VISIBILITYMAP_VALID_BITS);
 	}
 
 	/*
@@ -2283,12 +2625,13 @@ heap_prepare_insert(Relation relation, HeapTuple tup, TransactionId xid,
 					CommandId cid, int options)
 {
 	/*
-	 * For now, parallel operations are required to be strictly read-only.
-	 * Unlike heap_update() and heap_delete(), an insert should never create a
-	 * combo CID, so it might be possible to relax this restriction, but not
-	 * without more thought and testing.
+	 * For now, parallel operations are required to be strictly read-only,
+	 * except for parallel COPY FROM workers.  Unlike heap_update() and
+	 * heap_delete(), an insert never creates a combo CID, so inserting with
+	 * an XID and command ID the leader assigned before entering parallel
+	 * mode is safe.
 	 */
-	if (IsInParallelMode())
+	if (IsInParallelMode() && !ParallelWorkerInsertsAllowed)
 		ereport(ERROR,
 				(errcode(ERRCODE_INVALID_TRANSACTION_STATE),
 				 errmsg("cannot insert tuples during a parallel operation")));
@@ -2407,6 +2750,7 @@ heap_multi_insert(Relation relation, HeapTuple *tuples, int ntuples,
 		Buffer		buffer;
 		Buffer		vmbuffer = InvalidBuffer;
 		bool		all_visible_cleared = false;
+		bool		all_frozen_set = false;
 		int			nthispage;
 
 		CHECK_FOR_INTERRUPTS();
@@ -2420,6 +2764,30 @@ heap_multi_insert(Relation relation, HeapTuple *tuples, int ntuples,
 										   &vmbuffer, NULL);
 		page = BufferGetPage(buffer);
 
+		/*
+		 * If we're loading frozen tuples into an empty page, the page will be
+		 * all-visible and all-frozen once we're done, so mark it that way
+		 * right away; otherwise the first reader or VACUUM to come along
+		 * would have to dirty and write it all over again.  We need the
+		 * visibility map page pinned for that, but we don't want to do I/O
+		 * while holding the buffer lock.  No one else can be touching the
+		 * page, as the relation was created or truncated by our own
+		 * transaction, but recheck after relocking all the same.
+		 */
+		if ((options & HEAP_INSERT_FROZEN) &&
+			PageGetMaxOffsetNumber(page) == 0)
+		{
+			BlockNumber block = BufferGetBlockNumber(buffer);
+
+			if (!visibilitymap_pin_ok(block, vmbuffer))
+			{
+				LockBuffer(buffer, BUFFER_LOCK_UNLOCK);
+				visibilitymap_pin(relation, block, &vmbuffer);
+				LockBuffer(buffer, BUFFER_LOCK_EXCLUSIVE);
+			}
+			all_frozen_set = (PageGetMaxOffsetNumber(page) == 0);
+		}
+
 		/* NO EREPORT(ERROR) from here till changes are logged */
 		START_CRIT_SECTION();
 
@@ -2445,13 +2813,15 @@ heap_multi_insert(Relation relation, HeapTuple *tuples, int ntuples,
 				log_heap_new_cid(relation, heaptup);
 		}
 
-		if (PageIsAllVisible(page))
+		if (all_frozen_set)
+			PageSetAllVisible(page);
+		else if (PageIsAllVisible(page))
 		{
 			all_visible_cleared = true;
 			PageClearAllVisible(page);
 			visibilitymap_clear(relation,
 								BufferGetBlockNumber(buffer),
-								vmbuffer);
+								vmbuffer, VISIBILITYMAP_VALID_BITS);
 		}
 
 		/*
@@ -2495,7 +2865,11 @@ heap_multi_insert(Relation relation, HeapTuple *tuples, int ntuples,
 			/* the rest of the scratch space is used for tuple data */
 			tupledata = scratchptr;
 
-			xlrec->flags = all_visible_cleared ? XLH_INSERT_ALL_VISIBLE_CLEARED : 0;
+			xlrec->flags = 0;
+			if (all_visible_cleared)
+				xlrec->flags |= XLH_INSERT_ALL_VISIBLE_CLEARED;
+			if (all_frozen_set)
+				xlrec->flags |= XLH_INSERT_ALL_FROZEN_SET;
 			xlrec->ntuples = nthispage;
 
 			/*
@@ -2569,6 +2943,21 @@ heap_multi_insert(Relation relation, HeapTuple *tuples, int ntuples,
 
 		END_CRIT_SECTION();
 
+		/*
+		 * Now set the visibility map bits too.  This is WAL-logged
+		 * separately; if we crash in between, the page is merely left with
+		 * PD_ALL_VISIBLE set and the map bits clear, which is harmless.  If
+		 * we're skipping WAL for the heap, leave the map alone altogether,
+		 * as its WAL record would refer to a heap page that recovery might
+		 * not find; the next VACUUM will set the bits.
+		 */
+		if (all_frozen_set && !(options & HEAP_INSERT_SKIP_WAL))
+			visibilitymap_set(relation, BufferGetBlockNumber(buffer), buffer,
+							  InvalidXLogRecPtr, vmbuffer,
+							  InvalidTransactionId,
+							  VISIBILITYMAP_ALL_VISIBLE |
+							  VISIBILITYMAP_ALL_FROZEN);
+
 		UnlockReleaseBuffer(buffer);
 		if (vmbuffer != InvalidBuffer)
 			ReleaseBuffer(vmbuffer);
@@ -2930,7 +3319,7 @@ l1:
 		all_visible_cleared = true;
 		PageClearAllVisible(page);
 		visibilitymap_clear(relation, BufferGetBlockNumber(buffer),
-							vmbuffer);
+							vmbuffer, VISIBILITYMAP_VALID_BITS);
 	}
 
 	/* store transaction information of xact deleting the tuple */
@@ -3803,14 +4192,14 @@ l2:
 		all_visible_cleared = true;
 		PageClearAllVisible(BufferGetPage(buffer));
 		visibilitymap_clear(relation, BufferGetBlockNumber(buffer),
-							vmbuffer);
+							vmbuffer, VISIBILITYMAP_VALID_BITS);
 	}
 	if (newbuf != buffer && PageIsAllVisible(BufferGetPage(newbuf)))
 	{
 		all_visible_cleared_new = true;
 		PageClearAllVisible(BufferGetPage(newbuf));
 		visibilitymap_clear(relation, BufferGetBlockNumber(newbuf),
-							vmbuffer_new);
+							vmbuffer_new, VISIBILITYMAP_VALID_BITS);
 	}
 
 	if (newbuf != buffer)
@@ -4201,8 +4590,22 @@ heap_lock_tuple(Relation relation, HeapTuple tuple,
 				new_infomask2;
 	bool		first_time = true;
 	bool		have_tuple_lock = false;
+	bool		cleared_all_frozen = false;
+	BlockNumber block;
+	Buffer		vmbuffer = InvalidBuffer;
 
 	*buffer = ReadBuffer(relation, ItemPointerGetBlockNumber(tid));
+	block = ItemPointerGetBlockNumber(tid);
+
+	/*
+	 * Before locking the buffer, pin the visibility map page if it appears to
+	 * be necessary.  Since we haven't got the lock yet, someone else might be
+	 * in the middle of changing this, so we'll need to recheck after we have
+	 * the lock.
+	 */
+	if (PageIsAllVisible(BufferGetPage(*buffer)))
+		visibilitymap_pin(relation, block, &vmbuffer);
+
 	LockBuffer(*buffer, BUFFER_LOCK_EXCLUSIVE);
 
 	page = BufferGetPage(*buffer);
@@ -4226,7 +4629,8 @@ l3:
 		 * order to give that case the opportunity to throw a more specific
 		 * error.
 		 */
-		return HeapTupleInvisible;
+		result = HeapTupleInvisible;
+		goto out_unlocked;
 	}
 	else if (result == HeapTupleBeingUpdated)
 	{
@@ -4284,7 +4688,8 @@ l3:
 					if (TUPLOCK_from_mxstatus(members[i].status) >= mode)
 					{
 						pfree(members);
-						return HeapTupleMayBeUpdated;
+						result = HeapTupleMayBeUpdated;
+						goto out_unlocked;
 					}
 				}
 
@@ -4299,21 +4704,30 @@ l3:
 						Assert(HEAP_XMAX_IS_KEYSHR_LOCKED(infomask) ||
 							   HEAP_XMAX_IS_SHR_LOCKED(infomask) ||
 							   HEAP_XMAX_IS_EXCL_LOCKED(infomask));
-						return HeapTupleMayBeUpdated;
-						break;
+						result = HeapTupleMayBeUpdated;
+						goto out_unlocked;
 					case LockTupleShare:
 						if (HEAP_XMAX_IS_SHR_LOCKED(infomask) ||
 							HEAP_XMAX_IS_EXCL_LOCKED(infomask))
-							return HeapTupleMayBeUpdated;
+						{
+							result = HeapTupleMayBeUpdated;
+							goto out_unlocked;
+						}
 						break;
 					case LockTupleNoKeyExclusive:
 						if (HEAP_XMAX_IS_EXCL_LOCKED(infomask))
-							return HeapTupleMayBeUpdated;
+						{
+							result = HeapTupleMayBeUpdated;
+							goto out_unlocked;
+						}
 						break;
 					case LockTupleExclusive:
 						if (HEAP_XMAX_IS_EXCL_LOCKED(infomask) &&
 							infomask2 & HEAP_KEYS_UPDATED)
-							return HeapTupleMayBeUpdated;
+						{
+							result = HeapTupleMayBeUpdated;
+							goto out_unlocked;
+						}
 						break;
 				}
 			}
@@ -4667,7 +5081,24 @@ failed:
 		LockBuffer(*buffer, BUFFER_LOCK_UNLOCK);
 		if (have_tuple_lock)
 			UnlockTupleTuplock(relation, tid, mode);
-		return result;
+		goto out_unlocked;
+	}
+
+	/*
+	 * If we didn't pin the visibility map page and the page has become all
+	 * visible while we were busy locking the buffer, or during some
+	 * subsequent window during which we had it unlocked, we'll have to unlock
+	 * and re-lock, to avoid holding the buffer lock across I/O.  That's a bit
+	 * unfortunate, especially since we'll now have to recheck whether the
+	 * tuple has been locked or updated under us, but hopefully it won't
+	 * happen very often.
+	 */
+	if (vmbuffer == InvalidBuffer && PageIsAllVisible(page))
+	{
+		LockBuffer(*buffer, BUFFER_LOCK_UNLOCK);
+		visibilitymap_pin(relation, block, &vmbuffer);
+		LockBuffer(*buffer, BUFFER_LOCK_EXCLUSIVE);
+		goto l3;
 	}
 
 	xmax = HeapTupleHeaderGetRawXmax(tuple->t_data);
@@ -4722,6 +5153,16 @@ failed:
 	if (HEAP_XMAX_IS_LOCKED_ONLY(new_infomask))
 		tuple->t_data->t_ctid = *tid;
 
+	/*
+	 * Clear any all-frozen bit on the page: the tuple now carries an xmax
+	 * that a later aggressive vacuum must see.  The all-visible bit stays,
+	 * since a locker doesn't change tuple visibility.
+	 */
+	if (PageIsAllVisible(page) &&
+		visibilitymap_clear(relation, block, vmbuffer,
+							VISIBILITYMAP_ALL_FROZEN))
+		cleared_all_frozen = true;
+
 	MarkBufferDirty(*buffer);
 
 	/*
@@ -4748,6 +5189,7 @@ failed:
 		xlrec.locking_xid = xid;
 		xlrec.infobits_set = compute_infobits(new_infomask,
 											  tuple->t_data->t_infomask2);
+		xlrec.flags = cleared_all_frozen ? XLH_LOCK_ALL_FROZEN_CLEARED : 0;
 		XLogRegisterData((char *) &xlrec, SizeOfHeapLock);
 
 		/* we don't decode row locks atm, so no need to log the origin */
@@ -4761,11 +5203,6 @@ failed:
 
 	LockBuffer(*buffer, BUFFER_LOCK_UNLOCK);
 
-	/*
-	 * Don't update the visibility map here. Locking a tuple doesn't change
-	 * visibility info.
-	 */
-
 	/*
 	 * Now that we have successfully marked the tuple as locked, we can
 	 * release the lmgr tuple lock, if we had it.
@@ -4773,7 +5210,13 @@ failed:
 	if (have_tuple_lock)
 		UnlockTupleTuplock(relation, tid, mode);
 
-	return HeapTupleMayBeUpdated;
+	result = HeapTupleMayBeUpdated;
+
+out_unlocked:
+	if (BufferIsValid(vmbuffer))
+		ReleaseBuffer(vmbuffer);
+
+	return result;
 }
 
 /*
@@ -4911,8 +5354,8 @@ l5:
 		 * A multixact together with LOCK_ONLY set but neither lock bit set
 		 * (i.e. a pg_upgraded share locked tuple) cannot possibly be running
 		 * anymore.  This check is critical for databases upgraded by
-		 * pg_upgrade; both MultiXactIdIsRunning and MultiXactIdExpand assume
-		 * that such multis are never passed.
+		 * pg_upgrade; MultiXactIdIsRunning and the MultiXactIdExpand
+		 * functions assume that such multis are never passed.
 		 */
 		if (!(old_infomask & HEAP_LOCK_MASK) &&
 			HEAP_XMAX_IS_LOCKED_ONLY(old_infomask))
@@ -4922,21 +5365,38 @@ l5:
 			goto l5;
 		}
 
+		new_status = get_mxact_status_for_lock(mode, is_update);
+
 		/*
-		 * If the XMAX is already a MultiXactId, then we need to expand it to
-		 * include add_to_xmax; but if all the members were lockers and are
-		 * all gone, we can do away with the IS_MULTI bit and just set
-		 * add_to_xmax as the only locker/updater.  If all lockers are gone
-		 * and we have an updater that aborted, we can also do without a
-		 * multi.
-		 *
-		 * The cost of doing GetMultiXactIdMembers would be paid by
-		 * MultiXactIdExpand if we weren't to do this, so this check is not
-		 * incurring extra work anyhow.
+		 * If the multi only has lockers, which is the common case of a row
+		 * locked FOR KEY SHARE by foreign key checks, we can check which of
+		 * them are still running and expand it in a single pass.  If they
+		 * are all gone, we do away with the IS_MULTI bit and just set
+		 * add_to_xmax as the only locker/updater.
 		 */
-		if (!MultiXactIdIsRunning(xmax, HEAP_XMAX_IS_LOCKED_ONLY(old_infomask)))
+		if (HEAP_XMAX_IS_LOCKED_ONLY(old_infomask))
+		{
+			new_xmax = MultiXactIdExpandLockers((MultiXactId) xmax,
+												add_to_xmax, new_status);
+			if (!MultiXactIdIsValid(new_xmax))
+			{
+				old_infomask &= ~HEAP_XMAX_IS_MULTI;
+				old_infomask |= HEAP_XMAX_INVALID;
+				goto l5;
+			}
+		}
+		else
 		{
-			if (HEAP_XMAX_IS_LOCKED_ONLY(old_infomask) ||
+			/*
+			 * Otherwise the multi contains an update, and we need to expand
+			 * it to include add_to_xmax; but if all the lockers are gone and
+			 * the updater aborted, we can also do without a multi.
+			 *
+			 * The cost of doing GetMultiXactIdMembers would be paid by
+			 * MultiXactIdExpand if we weren't to do this, so this check is
+			 * not incurring extra work anyhow.
+			 */
+			if (!MultiXactIdIsRunning(xmax, false) &&
 				!TransactionIdDidCommit(MultiXactIdGetUpdateXid(xmax,
 															  old_infomask)))
 			{
@@ -4948,12 +5408,10 @@ l5:
 				old_infomask |= HEAP_XMAX_INVALID;
 				goto l5;
 			}
-		}
-
-		new_status = get_mxact_status_for_lock(mode, is_update);
 
-		new_xmax = MultiXactIdExpand((MultiXactId) xmax, add_to_xmax,
-									 new_status);
+			new_xmax = MultiXactIdExpand((MultiXactId) xmax, add_to_xmax,
+										 new_status);
+		}
 		GetMultiXactIdHintBits(new_xmax, &new_infomask, &new_infomask2);
 	}
 	else if (old_infomask & HEAP_XMAX_COMMITTED)
@@ -5216,6 +5674,10 @@ heap_lock_updated_tuple_rec(Relation rel, ItemPointer tid, TransactionId xid,
 	TransactionId xmax,
 				new_xmax;
 	TransactionId priorXmax = InvalidTransactionId;
+	bool		cleared_all_frozen = false;
+	Buffer		vmbuffer = InvalidBuffer;
+	BlockNumber block;
+	HTSU_Result result;
 
 	ItemPointerCopy(tid, &tupid);
 
@@ -5223,6 +5685,7 @@ heap_lock_updated_tuple_rec(Relation rel, ItemPointer tid, TransactionId xid,
 	{
 		new_infomask = 0;
 		new_xmax = InvalidTransactionId;
+		block = ItemPointerGetBlockNumber(&tupid);
 		ItemPointerCopy(&tupid, &(mytup.t_self));
 
 		if (!heap_fetch(rel, SnapshotAny, &mytup, &buf, false, NULL))
@@ -5234,13 +5697,37 @@ heap_lock_updated_tuple_rec(Relation rel, ItemPointer tid, TransactionId xid,
 			 * chain, and there's no further tuple to lock: return success to
 			 * caller.
 			 */
-			return HeapTupleMayBeUpdated;
+			result = HeapTupleMayBeUpdated;
+			goto out_unlocked;
 		}
 
 l4:
 		CHECK_FOR_INTERRUPTS();
+
+		/*
+		 * Before locking the buffer, pin the visibility map page if it
+		 * appears to be necessary.  Since we haven't got the lock yet,
+		 * someone else might be in the middle of changing this, so we'll need
+		 * to recheck after we have the lock.
+		 */
+		if (PageIsAllVisible(BufferGetPage(buf)))
+			visibilitymap_pin(rel, block, &vmbuffer);
+
 		LockBuffer(buf, BUFFER_LOCK_EXCLUSIVE);
 
+		/*
+		 * If we didn't pin the visibility map page and the page has become
+		 * all visible while we were busy locking the buffer, we'll have to
+		 * unlock and re-lock, to avoid holding the buffer lock across I/O.
+		 * That's a bit unfortunate, but hopefully shouldn't happen often.
+		 */
+		if (vmbuffer == InvalidBuffer && PageIsAllVisible(BufferGetPage(buf)))
+		{
+			LockBuffer(buf, BUFFER_LOCK_UNLOCK);
+			visibilitymap_pin(rel, block, &vmbuffer);
+			LockBuffer(buf, BUFFER_LOCK_EXCLUSIVE);
+		}
+
 		/*
 		 * Check the tuple XMIN against prior XMAX, if any.  If we reached the
 		 * end of the chain, we're done, so return success.
@@ -5249,8 +5736,8 @@ l4:
 			!TransactionIdEquals(HeapTupleHeaderGetXmin(mytup.t_data),
 								 priorXmax))
 		{
-			UnlockReleaseBuffer(buf);
-			return HeapTupleMayBeUpdated;
+			result = HeapTupleMayBeUpdated;
+			goto out_locked;
 		}
 
 		old_infomask = mytup.t_data->t_infomask;
@@ -5296,9 +5783,9 @@ l4:
 					}
 					if (res != HeapTupleMayBeUpdated)
 					{
-						UnlockReleaseBuffer(buf);
+						result = res;
 						pfree(members);
-						return res;
+						goto out_locked;
 					}
 				}
 				if (members)
@@ -5356,8 +5843,8 @@ l4:
 				}
 				if (res != HeapTupleMayBeUpdated)
 				{
-					UnlockReleaseBuffer(buf);
-					return res;
+					result = res;
+					goto out_locked;
 				}
 			}
 		}
@@ -5376,6 +5863,11 @@ l4:
 		mytup.t_data->t_infomask |= new_infomask;
 		mytup.t_data->t_infomask2 |= new_infomask2;
 
+		if (PageIsAllVisible(BufferGetPage(buf)) &&
+			visibilitymap_clear(rel, block, vmbuffer,
+								VISIBILITYMAP_ALL_FROZEN))
+			cleared_all_frozen = true;
+
 		MarkBufferDirty(buf);
 
 		/* XLOG stuff */
@@ -5391,6 +5883,8 @@ l4:
 			xlrec.offnum = ItemPointerGetOffsetNumber(&mytup.t_self);
 			xlrec.xmax = new_xmax;
 			xlrec.infobits_set = compute_infobits(new_infomask, new_infomask2);
+			xlrec.flags =
+				cleared_all_frozen ? XLH_LOCK_ALL_FROZEN_CLEARED : 0;
 
 			XLogRegisterData((char *) &xlrec, SizeOfHeapLockUpdated);
 
@@ -5406,15 +5900,28 @@ l4:
 			ItemPointerEquals(&mytup.t_self, &mytup.t_data->t_ctid) ||
 			HeapTupleHeaderIsOnlyLocked(mytup.t_data))
 		{
-			UnlockReleaseBuffer(buf);
-			return HeapTupleMayBeUpdated;
+			result = HeapTupleMayBeUpdated;
+			goto out_locked;
 		}
 
 		/* tail recursion */
 		priorXmax = HeapTupleHeaderGetUpdateXid(mytup.t_data);
 		ItemPointerCopy(&(mytup.t_data->t_ctid), &tupid);
 		UnlockReleaseBuffer(buf);
+		if (vmbuffer != InvalidBuffer)
+			ReleaseBuffer(vmbuffer);
+		vmbuffer = InvalidBuffer;
+		cleared_all_frozen = false;
 	}
+
+out_locked:
+	UnlockReleaseBuffer(buf);
+
+out_unlocked:
+	if (vmbuffer != InvalidBuffer)
+		ReleaseBuffer(vmbuffer);
+
+	return result;
 }
 
 /*
@@ -6066,7 +6573,9 @@ FreezeMultiXactId(MultiXactId multi, uint16 t_infomask,
  * are older than the specified cutoff XID and cutoff MultiXactId.  If so,
  * setup enough state (in the *frz output argument) to later execute and
  * WAL-log what we would need to do, and return TRUE.  Return FALSE if nothing
- * is to be changed.
+ * is to be changed.  In addition, set *totally_frozen to true if the tuple
+ * will be totally frozen after these operations are performed and false if
+ * more freezing will eventually be required.
  *
  * Caller is responsible for setting the offset field, if appropriate.
  *
@@ -6091,11 +6600,15 @@ FreezeMultiXactId(MultiXactId multi, uint16 t_infomask,
 bool
 heap_prepare_freeze_tuple(HeapTupleHeader tuple, TransactionId cutoff_xid,
 						  TransactionId cutoff_multi,
-						  xl_heap_freeze_tuple *frz)
+						  xl_heap_freeze_tuple *frz,
+						  bool *totally_frozen)
 
 {
 	bool		changed = false;
 	bool		freeze_xmax = false;
+	bool		xmin_frozen;
+	bool		xmax_already_frozen = false;
+	bool		xvac_frozen = true;
 	TransactionId xid;
 
 	frz->frzflags = 0;
@@ -6105,11 +6618,13 @@ heap_prepare_freeze_tuple(HeapTupleHeader tuple, TransactionId cutoff_xid,
 
 	/* Process xmin */
 	xid = HeapTupleHeaderGetXmin(tuple);
+	xmin_frozen = !TransactionIdIsNormal(xid) || HeapTupleHeaderXminFrozen(tuple);
 	if (TransactionIdIsNormal(xid) &&
 		TransactionIdPrecedes(xid, cutoff_xid))
 	{
 		frz->t_infomask |= HEAP_XMIN_FROZEN;
 		changed = true;
+		xmin_frozen = true;
 	}
 
 	/*
@@ -6179,6 +6694,8 @@ heap_prepare_freeze_tuple(HeapTupleHeader tuple, TransactionId cutoff_xid,
 	{
 		freeze_xmax = true;
 	}
+	else if (!TransactionIdIsValid(xid))
+		xmax_already_frozen = true;
 
 	if (freeze_xmax)
 	{
@@ -6224,8 +6741,13 @@ heap_prepare_freeze_tuple(HeapTupleHeader tuple, TransactionId cutoff_xid,
 			frz->t_infomask |= HEAP_XMIN_COMMITTED;
 			changed = true;
 		}
+		else if (TransactionIdIsNormal(xid))
+			xvac_frozen = false;
 	}
 
+	*totally_frozen = (xmin_frozen && xvac_frozen &&
+					   (freeze_xmax || xmax_already_frozen));
+
 	return changed;
 }
 
@@ -6276,9 +6798,10 @@ heap_freeze_tuple(HeapTupleHeader tuple, TransactionId cutoff_xid,
 {
 	xl_heap_freeze_tuple frz;
 	bool		do_freeze;
+	bool		tuple_totally_frozen;
 
 	do_freeze = heap_prepare_freeze_tuple(tuple, cutoff_xid, cutoff_multi,
-										  &frz);
+										  &frz, &tuple_totally_frozen);
 
 	/*
 	 * Note that because this is not a WAL-logged operation, we don't need to
@@ -6639,6 +7162,55 @@ ConditionalMultiXactIdWait(MultiXactId multi, MultiXactStatus status,
 							  rel, NULL, XLTW_None, remaining);
 }
 
+/*
+ * heap_tuple_needs_eventual_freeze
+ *
+ * Check to see whether any of the XID fields of a tuple (xmin, xmax, xvac)
+ * will eventually require freezing.  Similar to heap_tuple_needs_freeze,
+ * but there's no cutoff, since we're trying to figure out whether freezing
+ * will ever be needed, not whether it's needed now.
+ */
+bool
+heap_tuple_needs_eventual_freeze(HeapTupleHeader tuple)
+{
+	TransactionId xid;
+
+	/*
+	 * If xmin is a normal transaction ID, this tuple is definitely not
+	 * frozen.
+	 */
+	xid = HeapTupleHeaderGetXmin(tuple);
+	if (TransactionIdIsNormal(xid))
+		return true;
+
+	/*
+	 * If xmax is a valid xact or multixact, this tuple is also not frozen.
+	 */
+	if (tuple->t_infomask & HEAP_XMAX_IS_MULTI)
+	{
+		MultiXactId multi;
+
+		multi = HeapTupleHeaderGetRawXmax(tuple);
+		if (MultiXactIdIsValid(multi))
+			return true;
+	}
+	else
+	{
+		xid = HeapTupleHeaderGetRawXmax(tuple);
+		if (TransactionIdIsNormal(xid))
+			return true;
+	}
+
+	if (tuple->t_infomask & HEAP_MOVED)
+	{
+		xid = HeapTupleHeaderGetXvac(tuple);
+		if (TransactionIdIsNormal(xid))
+			return true;
+	}
+
+	return false;
+}
+
 /*
  * heap_tuple_needs_freeze
  *
@@ -6893,7 +7465,7 @@ log_heap_freeze(Relation reln, Buffer buffer, TransactionId cutoff_xid,
  */
 XLogRecPtr
 log_heap_visible(RelFileNode rnode, Buffer heap_buffer, Buffer vm_buffer,
-				 TransactionId cutoff_xid)
+				 TransactionId cutoff_xid, uint8 vmflags)
 {
 	xl_heap_visible xlrec;
 	XLogRecPtr	recptr;
@@ -6903,6 +7475,7 @@ log_heap_visible(RelFileNode rnode, Buffer heap_buffer, Buffer vm_buffer,
 	Assert(BufferIsValid(vm_buffer));
 
 	xlrec.cutoff_xid = cutoff_xid;
+	xlrec.flags = vmflags;
 	XLogBeginInsert();
 	XLogRegisterData((char *) &xlrec, SizeOfHeapVisible);
 
@@ -7543,7 +8116,7 @@ heap_xlog_visible(XLogReaderState *record)
 		 */
 		if (lsn > PageGetLSN(vmpage))
 			visibilitymap_set(reln, blkno, InvalidBuffer, lsn, vmbuffer,
-							  xlrec->cutoff_xid);
+							  xlrec->cutoff_xid, xlrec->flags);
 
 		ReleaseBuffer(vmbuffer);
 		FreeFakeRelcacheEntry(reln);
@@ -7658,7 +8231,7 @@ heap_xlog_delete(XLogReaderState *record)
 		Buffer		vmbuffer = InvalidBuffer;
 
 		visibilitymap_pin(reln, blkno, &vmbuffer);
-		visibilitymap_clear(reln, blkno, vmbuffer);
+		visibilitymap_clear(reln, blkno, vmbuffer, VISIBILITYMAP_VALID_BITS);
 		ReleaseBuffer(vmbuffer);
 		FreeFakeRelcacheEntry(reln);
 	}
@@ -7736,7 +8309,7 @@ heap_xlog_insert(XLogReaderState *record)
 		Buffer		vmbuffer = InvalidBuffer;
 
 		visibilitymap_pin(reln, blkno, &vmbuffer);
-		visibilitymap_clear(reln, blkno, vmbuffer);
+		visibilitymap_clear(reln, blkno, vmbuffer, VISIBILITYMAP_VALID_BITS);
 		ReleaseBuffer(vmbuffer);
 		FreeFakeRelcacheEntry(reln);
 	}
@@ -7856,7 +8429,7 @@ heap_xlog_multi_insert(XLogReaderState *record)
 		Buffer		vmbuffer = InvalidBuffer;
 
 		visibilitymap_pin(reln, blkno, &vmbuffer);
-		visibilitymap_clear(reln, blkno, vmbuffer);
+		visibilitymap_clear(reln, blkno, vmbuffer, VISIBILITYMAP_VALID_BITS);
 		ReleaseBuffer(vmbuffer);
 		FreeFakeRelcacheEntry(reln);
 	}
@@ -7934,6 +8507,8 @@ heap_xlog_multi_insert(XLogReaderState *record)
 
 		if (xlrec->flags & XLH_INSERT_ALL_VISIBLE_CLEARED)
 			PageClearAllVisible(page);
+		if (xlrec->flags & XLH_INSERT_ALL_FROZEN_SET)
+			PageSetAllVisible(page);
 
 		MarkBufferDirty(buffer);
 	}
@@ -8011,7 +8586,7 @@ heap_xlog_update(XLogReaderState *record, bool hot_update)
 		Buffer		vmbuffer = InvalidBuffer;
 
 		visibilitymap_pin(reln, oldblk, &vmbuffer);
-		visibilitymap_clear(reln, oldblk, vmbuffer);
+		visibilitymap_clear(reln, oldblk, vmbuffer, VISIBILITYMAP_VALID_BITS);
 		ReleaseBuffer(vmbuffer);
 		FreeFakeRelcacheEntry(reln);
 	}
@@ -8095,7 +8670,7 @@ heap_xlog_update(XLogReaderState *record, bool hot_update)
 		Buffer		vmbuffer = InvalidBuffer;
 
 		visibilitymap_pin(reln, newblk, &vmbuffer);
-		visibilitymap_clear(reln, newblk, vmbuffer);
+		visibilitymap_clear(reln, newblk, vmbuffer, VISIBILITYMAP_VALID_BITS);
 		ReleaseBuffer(vmbuffer);
 		FreeFakeRelcacheEntry(reln);
 	}
@@ -8275,6 +8850,27 @@ heap_xlog_lock(XLogReaderState *record)
 	ItemId		lp = NULL;
 	HeapTupleHeader htup;
 
+	/*
+	 * The visibility map may need to be fixed even if the heap page is
+	 * already up-to-date.
+	 */
+	if (xlrec->flags & XLH_LOCK_ALL_FROZEN_CLEARED)
+	{
+		RelFileNode rnode;
+		Buffer		vmbuffer = InvalidBuffer;
+		BlockNumber block;
+		Relation	reln;
+
+		XLogRecGetBlockTag(record, 0, &rnode, NULL, &block);
+		reln = CreateFakeRelcacheEntry(rnode);
+
+		visibilitymap_pin(reln, block, &vmbuffer);
+		visibilitymap_clear(reln, block, vmbuffer, VISIBILITYMAP_ALL_FROZEN);
+
+		ReleaseBuffer(vmbuffer);
+		FreeFakeRelcacheEntry(reln);
+	}
+
 	if (XLogReadBufferForRedo(record, 0, &buffer) == BLK_NEEDS_REDO)
 	{
 		page = (Page) BufferGetPage(buffer);
@@ -8325,6 +8921,27 @@ heap_xlog_lock_updated(XLogReaderState *record)
 
 	xlrec = (xl_heap_lock_updated *) XLogRecGetData(record);
 
+	/*
+	 * The visibility map may need to be fixed even if the heap page is
+	 * already up-to-date.
+	 */
+	if (xlrec->flags & XLH_LOCK_ALL_FROZEN_CLEARED)
+	{
+		RelFileNode rnode;
+		Buffer		vmbuffer = InvalidBuffer;
+		BlockNumber block;
+		Relation	reln;
+
+		XLogRecGetBlockTag(record, 0, &rnode, NULL, &block);
+		reln = CreateFakeRelcacheEntry(rnode);
+
+		visibilitymap_pin(reln, block, &vmbuffer);
+		visibilitymap_clear(reln, block, vmbuffer, VISIBILITYMAP_ALL_FROZEN);
+
+		ReleaseBuffer(vmbuffer);
+		FreeFakeRelcacheEntry(reln);
+	}
+
 	if (XLogReadBufferForRedo(record, 0, &buffer) == BLK_NEEDS_REDO)
 	{
 		page = BufferGetPage(buffer);
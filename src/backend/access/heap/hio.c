@@ -19,6 +19,7 @@
 #include "access/hio.h"
 #include "access/htup_details.h"
 #include "access/visibilitymap.h"
+#include "pgstat.h"
 #include "storage/bufmgr.h"
 #include "storage/freespace.h"
 #include "storage/lmgr.h"
@@ -110,6 +111,90 @@ ReadBufferBI(Relation relation, BlockNumber targetBlock,
 	return buffer;
 }
 
+/*
+ * Upper limit on the number of pages RelationAddExtraBlocks adds at once,
+ * and the number added for each backend waiting for the extension lock.
+ */
+#define EXTRA_BLOCKS_MAX		512
+#define EXTRA_BLOCKS_PER_WAITER	20
+
+/*
+ * Extend a relation by multiple blocks to avoid future contention on the
+ * relation extension lock.  Our goal is to pre-extend the relation by an
+ * amount which ramps up as the degree of contention ramps up, but limiting
+ * the result to some sane overall value.
+ *
+ * The new pages are initialized and entered into the FSM, upper levels
+ * included, so that the backends waiting behind us find them as soon as we
+ * release the lock.  Caller must hold the relation extension lock.
+ */
+static void
+RelationAddExtraBlocks(Relation relation, BulkInsertState bistate)
+{
+	BlockNumber firstBlock = InvalidBlockNumber;
+	BlockNumber blockNum = InvalidBlockNumber;
+	Size		freespace = 0;
+	int			lockWaiters;
+	int			extraBlocks;
+
+	/* Use the length of the lock wait queue to judge how much to extend. */
+	lockWaiters = RelationExtensionLockWaiterCount(relation);
+	if (lockWaiters <= 0)
+		return;
+
+	extraBlocks = Min(EXTRA_BLOCKS_MAX, lockWaiters * EXTRA_BLOCKS_PER_WAITER);
+
+	/*
+	 * Have the file system allocate space for all the pages in one go,
+	 * including the one our caller is about to add for itself, instead of
+	 * a page at a time as each is written.
+	 */
+	RelationOpenSmgr(relation);
+	smgrpreallocate(relation->rd_smgr, MAIN_FORKNUM,
+					RelationGetNumberOfBlocks(relation), extraBlocks + 1);
+
+	while (extraBlocks-- > 0)
+	{
+		Buffer		buffer;
+		Page		page;
+
+		/*
+		 * Extend by one page.  This should generally match the main-line
+		 * extension code in RelationGetBufferForTuple, except that we hold
+		 * the relation extension lock throughout.
+		 */
+		buffer = ReadBufferBI(relation, P_NEW, bistate);
+
+		LockBuffer(buffer, BUFFER_LOCK_EXCLUSIVE);
+		page = BufferGetPage(buffer);
+
+		if (!PageIsNew(page))
+			elog(ERROR, "page %u of relation \"%s\" should be empty but is not",
+				 BufferGetBlockNumber(buffer),
+				 RelationGetRelationName(relation));
+
+		PageInit(page, BufferGetPageSize(buffer), 0);
+
+		/*
+		 * We mark all the new buffers dirty, but do nothing to write them
+		 * out; they'll probably get used soon, and even if they are not, a
+		 * crash will leave an okay all-zeroes page on disk.
+		 */
+		MarkBufferDirty(buffer);
+
+		blockNum = BufferGetBlockNumber(buffer);
+		freespace = PageGetHeapFreeSpace(page);
+
+		UnlockReleaseBuffer(buffer);
+
+		if (firstBlock == InvalidBlockNumber)
+			firstBlock = blockNum;
+	}
+
+	/* All the new pages have the same amount of free space; record them. */
+	RecordPageRangeWithFreeSpace(relation, firstBlock, blockNum, freespace);
+}
+
 /*
  * For each heap page which is all-visible, acquire a pin on the appropriate
  * visibility map page, if we haven't already got one.
@@ -308,6 +393,7 @@ RelationGetBufferForTuple(Relation relation, Size len,
 		}
 	}
 
+loop:
 	while (targetBlock != InvalidBlockNumber)
 	{
 		/*
@@ -440,9 +526,44 @@ RelationGetBufferForTuple(Relation relation, Size len,
 	 */
 	needLock = !RELATION_IS_LOCAL(relation);
 
-	if (needLock)
+	/*
+	 * If we need the lock but are not able to acquire it immediately, we'll
+	 * consider extending the relation by multiple blocks at a time to manage
+	 * contention on the relation extension lock.  However, this only makes
+	 * sense if we're using the FSM; otherwise, there's no point.
+	 */
+	if (needLock && !ConditionalLockRelationForExtension(relation,
+														 ExclusiveLock))
+	{
+		pgstat_count_extension_lock_wait(relation);
+
+		/* Couldn't get the lock immediately; wait for it. */
 		LockRelationForExtension(relation, ExclusiveLock);
 
+		if (use_fsm)
+		{
+			/*
+			 * Check if some other backend has extended a block for us while
+			 * we were waiting on the lock.
+			 */
+			targetBlock = GetPageWithFreeSpace(relation,
+											   len + saveFreeSpace);
+
+			/*
+			 * If some other waiter has already extended the relation, we
+			 * don't need to do so; just use the existing freespace.
+			 */
+			if (targetBlock != InvalidBlockNumber)
+			{
+				UnlockRelationForExtension(relation, ExclusiveLock);
+				goto loop;
+			}
+
+			/* Time to bulk-extend. */
+			RelationAddExtraBlocks(relation, bistate);
+		}
+	}
+
 	/*
 	 * XXX This does an lseek - rather expensive - but at the moment it is the
 	 * only way to accurately determine how many blocks are in a relation.  Is
@@ -18,15 +18,27 @@
 #include "access/heapam_xlog.h"
 #include "access/transam.h"
 #include "access/htup_details.h"
+#include "access/xact.h"
 #include "access/xlog.h"
 #include "catalog/catalog.h"
 #include "miscadmin.h"
 #include "pgstat.h"
+#include "postmaster/autovacuum.h"
 #include "storage/bufmgr.h"
 #include "utils/snapmgr.h"
 #include "utils/rel.h"
 #include "utils/tqual.h"
 
+/* GUC variable */
+bool		defer_heap_pruning = false;
+
+/*
+ * Deferred pruning is requested for ranges of this many pages, so that a
+ * query reading through a table that needs a lot of pruning doesn't fill up
+ * autovacuum's work item array with a request per page.
+ */
+#define PRUNE_RANGE_PAGES	32
+
 /* Working data for heap_page_prune and subroutines */
 typedef struct
 {
@@ -54,6 +66,7 @@ static void heap_prune_record_redirect(PruneState *prstate,
 						   OffsetNumber offnum, OffsetNumber rdoffnum);
 static void heap_prune_record_dead(PruneState *prstate, OffsetNumber offnum);
 static void heap_prune_record_unused(PruneState *prstate, OffsetNumber offnum);
+static bool heap_prune_defer(Relation relation, Buffer buffer);
 
 
 /*
@@ -66,6 +79,12 @@ static void heap_prune_record_unused(PruneState *prstate, OffsetNumber offnum);
  * Note: this is called quite often.  It's important that it fall out quickly
  * if there's not any use in pruning.
  *
+ * If defer_heap_pruning is set, the page is left for an autovacuum worker
+ * to prune instead, if we can arrange that, so as to keep the work and the
+ * cleanup lock out of the query's way.  Not so if an UPDATE has already
+ * failed to find room on the page, though: the next one would then have to
+ * put its new tuple version elsewhere too, instead of making it a HOT update.
+ *
  * Caller must have pin on the buffer, and must *not* have a lock on it.
  *
  * OldestXmin is the cutoff XID used to distinguish whether tuples are DEAD
@@ -128,6 +147,10 @@ heap_page_prune_opt(Relation relation, Buffer buffer)
 
 	if (PageIsFull(page) || PageGetHeapFreeSpace(page) < minfree)
 	{
+		if (defer_heap_pruning && !PageIsFull(page) &&
+			heap_prune_defer(relation, buffer))
+			return;
+
 		/* OK, try to get exclusive buffer lock */
 		if (!ConditionalLockBufferForCleanup(buffer))
 			return;
@@ -153,6 +176,100 @@ heap_page_prune_opt(Relation relation, Buffer buffer)
 }
 
 
+/*
+ * Hand the pruning of the given page over to an autovacuum worker.
+ *
+ * Returns false if that can't be done, in which case the caller had better
+ * prune the page itself.  Each backend remembers the last page range it
+ * asked about, and asks again for the same range only in a new statement;
+ * the request is probably still queued until then, and we don't want every
+ * reader of a popular page to go bother AutovacuumLock meanwhile.
+ */
+static bool
+heap_prune_defer(Relation relation, Buffer buffer)
+{
+	static Oid	lastRelid = InvalidOid;
+	static BlockNumber lastRange = InvalidBlockNumber;
+	static TimestampTz lastStmtTime = 0;
+	BlockNumber range;
+	TimestampTz stmtTime;
+
+	/* autovacuum can't get at temp tables, and must not defer to itself */
+	if (RelationUsesLocalBuffers(relation) || IsAutoVacuumWorkerProcess())
+		return false;
+
+	range = BufferGetBlockNumber(buffer);
+	range -= range % PRUNE_RANGE_PAGES;
+	stmtTime = GetCurrentStatementStartTimestamp();
+
+	if (RelationGetRelid(relation) != lastRelid || range != lastRange ||
+		stmtTime != lastStmtTime)
+	{
+		if (!AutoVacuumRequestWork(AVW_HeapPruneRange,
+								   RelationGetRelid(relation), range))
+			return false;
+		lastRelid = RelationGetRelid(relation);
+		lastRange = range;
+		lastStmtTime = stmtTime;
+	}
+
+	pgstat_count_heap_prune_deferred(relation);
+
+	return true;
+}
+
+/*
+ * Prune the pages of a range whose pruning was deferred by queries, in an
+ * autovacuum worker.
+ *
+ * Each page is given the same treatment as heap_page_prune_opt would have
+ * given it, so pages that no longer need pruning, or that someone else has
+ * pinned, are left alone.  The table may have been truncated meanwhile, and
+ * may not even be a table anymore if its OID has been reused.
+ */
+void
+heap_prune_range(Oid relid, BlockNumber startblk)
+{
+	Relation	rel;
+	BlockNumber nblocks;
+	BlockNumber blkno;
+
+	rel = try_relation_open(relid, AccessShareLock);
+	if (rel == NULL)
+		return;
+
+	if (rel->rd_rel->relkind != RELKIND_RELATION &&
+		rel->rd_rel->relkind != RELKIND_MATVIEW &&
+		rel->rd_rel->relkind != RELKIND_TOASTVALUE)
+	{
+		relation_close(rel, AccessShareLock);
+		return;
+	}
+
+	/* we need a fresh snapshot to have a current RecentGlobalXmin */
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	nblocks = RelationGetNumberOfBlocks(rel);
+	for (blkno = startblk;
+		 blkno < startblk + PRUNE_RANGE_PAGES && blkno < nblocks;
+		 blkno++)
+	{
+		Buffer		buffer;
+
+		CHECK_FOR_INTERRUPTS();
+
+		buffer = ReadBufferExtended(rel, MAIN_FORKNUM, blkno,
+									RBM_NORMAL, NULL);
+		heap_page_prune_opt(rel, buffer);
+		ReleaseBuffer(buffer);
+	}
+
+	PopActiveSnapshot();
+
+	relation_close(rel, AccessShareLock);
+}
+
+
 /*
  * Prune and repair fragmentation in the specified page.
  *
@@ -30,6 +30,13 @@
 #include <unistd.h>
 #include <fcntl.h>
 
+#ifdef USE_LZ4
+#include <lz4.h>
+#endif
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
 #include "access/genam.h"
 #include "access/heapam.h"
 #include "access/tuptoaster.h"
@@ -37,8 +44,11 @@
 #include "catalog/catalog.h"
 #include "common/pg_lzcompress.h"
 #include "miscadmin.h"
+#include "utils/attoptcache.h"
 #include "utils/expandeddatum.h"
 #include "utils/fmgroids.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"
 #include "utils/rel.h"
 #include "utils/typcache.h"
 #include "utils/tqual.h"
@@ -52,7 +62,7 @@
 typedef struct toast_compress_header
 {
 	int32		vl_len_;		/* varlena header (do not touch directly!) */
-	int32		rawsize;
+	uint32		rawsize;		/* raw size, and method in the top bits */
 } toast_compress_header;
 
 /*
@@ -60,11 +70,61 @@ typedef struct toast_compress_header
  * toast entries.
  */
 #define TOAST_COMPRESS_HDRSZ		((int32) sizeof(toast_compress_header))
-#define TOAST_COMPRESS_RAWSIZE(ptr) (((toast_compress_header *) (ptr))->rawsize)
+#define TOAST_COMPRESS_RAWSIZE(ptr) \
+	((int32) (((toast_compress_header *) (ptr))->rawsize & VARLENA_RAWSIZE_MASK))
+#define TOAST_COMPRESS_METHOD(ptr) \
+	((int) (((toast_compress_header *) (ptr))->rawsize >> VARLENA_RAWSIZE_BITS))
 #define TOAST_COMPRESS_RAWDATA(ptr) \
 	(((char *) (ptr)) + TOAST_COMPRESS_HDRSZ)
-#define TOAST_COMPRESS_SET_RAWSIZE(ptr, len) \
-	(((toast_compress_header *) (ptr))->rawsize = (len))
+#define TOAST_COMPRESS_SET_RAWSIZE(ptr, len, method) \
+	(((toast_compress_header *) (ptr))->rawsize = \
+	 (uint32) (len) | ((uint32) (method) << VARLENA_RAWSIZE_BITS))
+
+/* GUC variable */
+int			default_toast_compression = TOAST_PGLZ_COMPRESSION;
+
+/*
+ * Names of the compression methods, for default_toast_compression and the
+ * "compression" attribute option.  Methods the server was built without are
+ * not accepted.
+ */
+const struct config_enum_entry default_toast_compression_options[] = {
+	{"pglz", TOAST_PGLZ_COMPRESSION, false},
+#ifdef USE_LZ4
+	{"lz4", TOAST_LZ4_COMPRESSION, false},
+#endif
+#ifdef USE_ZSTD
+	{"zstd", TOAST_ZSTD_COMPRESSION, false},
+#endif
+	{NULL, 0, false}
+};
+
+/*
+ * An expanded toast value, see expand_toast_value.  The detoasted data is
+ * kept in the buffer of the iterator.
+ */
+typedef struct ExpandedToastValue
+{
+	ExpandedObjectHeader hdr;
+	char		toast_pointer[TOAST_POINTER_SIZE];	/* the value's pointer */
+	DetoastIteratorData iter;	/* detoasts the value as needed */
+} ExpandedToastValue;
+
+static Size ETV_get_flat_size(ExpandedObjectHeader *eohptr);
+static void ETV_flatten_into(ExpandedObjectHeader *eohptr,
+				 void *result, Size allocated_size);
+
+static const ExpandedObjectMethods ETV_methods =
+{
+	ETV_get_flat_size,
+	ETV_flatten_into
+};
+
+#ifdef USE_ZSTD
+/* zstd contexts are expensive to set up, so keep them around */
+static ZSTD_CCtx *zstd_cctx = NULL;
+static ZSTD_DCtx *zstd_dctx = NULL;
+#endif
 
 static void toast_delete_datum(Relation rel, Datum value);
 static Datum toast_save_datum(Relation rel, Datum value,
@@ -75,6 +135,18 @@ static struct varlena *toast_fetch_datum(struct varlena * attr);
 static struct varlena *toast_fetch_datum_slice(struct varlena * attr,
 						int32 sliceoffset, int32 length);
 static struct varlena *toast_decompress_datum(struct varlena * attr);
+static void init_detoast_iterator(DetoastIterator iter, struct varlena * attr);
+static void detoast_iterator_fetch(DetoastIterator iter, int32 upto);
+static ExpandedToastValue *get_expanded_toast_value(struct varlena * attr);
+static struct varlena *toast_decompress_datum_slice(struct varlena * attr,
+							 int32 slicelength);
+static void toast_decompress_prefix(struct varlena * attr, char *dest,
+						int32 prefixlen);
+#ifdef USE_ZSTD
+static ZSTD_DCtx *toast_get_zstd_dctx(void);
+#endif
+static int	toast_get_compression_method(Relation rel, int attnum);
+static void toast_compression_not_supported(int method);
 static int toast_open_indexes(Relation toastrel,
 				   LOCKMODE lock,
 				   Relation **toastidxs,
@@ -271,8 +343,33 @@ heap_tuple_untoast_attr_slice(struct varlena * attr,
 		if (!VARATT_EXTERNAL_IS_COMPRESSED(toast_pointer))
 			return toast_fetch_datum_slice(attr, sliceoffset, slicelength);
 
-		/* fetch it back (compressed marker will get set automatically) */
-		preslice = toast_fetch_datum(attr);
+		/*
+		 * If only a prefix of the value is wanted, and the value is pglz
+		 * compressed, a bounded prefix of the compressed data is enough.
+		 * We can't tell the compression method without fetching the start
+		 * of the data, so fetch that prefix on spec, and go back for the
+		 * rest if the value turns out to use another method.  (Compressed
+		 * marker will get set automatically in either case.)
+		 */
+		if (slicelength >= 0 &&
+			(int64) sliceoffset + slicelength < toast_pointer.va_rawsize - VARHDRSZ)
+		{
+			int32		hdrsz = TOAST_COMPRESS_HDRSZ - VARHDRSZ;
+			int32		max_size;
+
+			max_size = pglz_maximum_compressed_size(sliceoffset + slicelength,
+											toast_pointer.va_extsize - hdrsz);
+			preslice = toast_fetch_datum_slice(attr, 0, max_size + hdrsz);
+
+			if (TOAST_COMPRESS_METHOD(preslice) != TOAST_PGLZ_COMPRESSION &&
+				max_size + hdrsz < toast_pointer.va_extsize)
+			{
+				pfree(preslice);
+				preslice = toast_fetch_datum(attr);
+			}
+		}
+		else
+			preslice = toast_fetch_datum(attr);
 	}
 	else if (VARATT_IS_EXTERNAL_INDIRECT(attr))
 	{
@@ -288,6 +385,32 @@ heap_tuple_untoast_attr_slice(struct varlena * attr,
 	}
 	else if (VARATT_IS_EXTERNAL_EXPANDED(attr))
 	{
+		ExpandedToastValue *etv = get_expanded_toast_value(attr);
+
+		/* an expanded toast value needn't be detoasted past the slice */
+		if (etv != NULL)
+		{
+			attrsize = etv->iter.rawsize;
+
+			if (sliceoffset >= attrsize)
+			{
+				sliceoffset = 0;
+				slicelength = 0;
+			}
+
+			if (((sliceoffset + slicelength) > attrsize) || slicelength < 0)
+				slicelength = attrsize - sliceoffset;
+
+			detoast_iterate_to(&etv->iter, sliceoffset + slicelength);
+
+			result = (struct varlena *) palloc(slicelength + VARHDRSZ);
+			SET_VARSIZE(result, slicelength + VARHDRSZ);
+			memcpy(VARDATA(result), VARDATA(etv->iter.buf) + sliceoffset,
+				   slicelength);
+
+			return result;
+		}
+
 		/* pass it off to heap_tuple_fetch_attr to flatten */
 		preslice = heap_tuple_fetch_attr(attr);
 	}
@@ -300,7 +423,12 @@ heap_tuple_untoast_attr_slice(struct varlena * attr,
 	{
 		struct varlena *tmp = preslice;
 
-		preslice = toast_decompress_datum(tmp);
+		/* decompress only as far as the end of the slice */
+		if (slicelength >= 0 && sliceoffset < PG_INT32_MAX - slicelength)
+			preslice = toast_decompress_datum_slice(tmp,
+													sliceoffset + slicelength);
+		else
+			preslice = toast_decompress_datum(tmp);
 
 		if (tmp != attr)
 			pfree(tmp);
@@ -340,6 +468,314 @@ heap_tuple_untoast_attr_slice(struct varlena * attr,
 }
 
 
+/*
+ * A detoast iterator advances by at least this much at a time.  Each step
+ * also at least doubles the available data, since a compressed value has to
+ * be decompressed from the start every time.
+ */
+#define DETOAST_ITERATE_MIN_STEP	BLCKSZ
+
+/* ----------
+ * create_detoast_iterator -
+ *
+ *	Set up to detoast a value a piece at a time.  Values that aren't
+ *	stored externally or compressed are simply detoasted all at once.
+ * ----------
+ */
+DetoastIterator
+create_detoast_iterator(struct varlena * attr)
+{
+	DetoastIterator iter;
+	ExpandedToastValue *etv;
+
+	/* an expanded toast value lends out its own iterator */
+	etv = get_expanded_toast_value(attr);
+	if (etv != NULL)
+		return &etv->iter;
+
+	iter = (DetoastIterator) palloc0(sizeof(DetoastIteratorData));
+	init_detoast_iterator(iter, attr);
+
+	return iter;
+}
+
+/*
+ * Workhorse for create_detoast_iterator and expand_toast_value: set up
+ * a zeroed iterator, allocating its buffers in CurrentMemoryContext.
+ */
+static void
+init_detoast_iterator(DetoastIterator iter, struct varlena * attr)
+{
+	if (VARATT_IS_EXTERNAL_INDIRECT(attr))
+	{
+		struct varatt_indirect redirect;
+
+		VARATT_EXTERNAL_GET_POINTER(redirect, attr);
+		attr = (struct varlena *) redirect.pointer;
+
+		/* nested indirect Datums aren't allowed */
+		Assert(!VARATT_IS_EXTERNAL_INDIRECT(attr));
+	}
+
+	iter->source = attr;
+
+	if (VARATT_IS_EXTERNAL_ONDISK(attr))
+	{
+		struct varatt_external toast_pointer;
+
+		VARATT_EXTERNAL_GET_POINTER(toast_pointer, attr);
+		iter->rawsize = toast_pointer.va_rawsize - VARHDRSZ;
+
+		if (VARATT_EXTERNAL_IS_COMPRESSED(toast_pointer))
+		{
+			/* compressed data is fetched as needed, see detoast_iterate_to */
+			iter->compressed_size = toast_pointer.va_extsize;
+			iter->compressed = (struct varlena *)
+				palloc(iter->compressed_size + VARHDRSZ);
+			SET_VARSIZE_COMPRESSED(iter->compressed, VARHDRSZ);
+		}
+	}
+	else if (VARATT_IS_COMPRESSED(attr))
+	{
+		iter->rawsize = TOAST_COMPRESS_RAWSIZE(attr);
+		iter->compressed = attr;
+		iter->compressed_size = VARSIZE(attr) - VARHDRSZ;
+	}
+	else
+	{
+		/* nothing to gain by iterating */
+		iter->buf = heap_tuple_untoast_attr(attr);
+		iter->rawsize = VARSIZE(iter->buf) - VARHDRSZ;
+		iter->done = iter->rawsize;
+		return;
+	}
+
+	iter->buf = (struct varlena *) palloc(iter->rawsize + VARHDRSZ);
+	SET_VARSIZE(iter->buf, iter->rawsize + VARHDRSZ);
+}
+
+/* ----------
+ * detoast_iterate -
+ *
+ *	Make more of the data available.  Returns false if there was no more.
+ * ----------
+ */
+bool
+detoast_iterate(DetoastIterator iter)
+{
+	if (iter->done >= iter->rawsize)
+		return false;
+
+	detoast_iterate_to(iter, iter->done + 1);
+
+	return true;
+}
+
+/* ----------
+ * detoast_iterate_to -
+ *
+ *	Make at least the first "needed" bytes of the data available.
+ * ----------
+ */
+void
+detoast_iterate_to(DetoastIterator iter, int32 needed)
+{
+	int64		target;
+
+	if (needed <= iter->done || iter->done >= iter->rawsize)
+		return;
+
+	target = Max(needed, (int64) iter->done * 2);
+	target = Max(target, DETOAST_ITERATE_MIN_STEP);
+	target = Min(target, iter->rawsize);
+
+	if (iter->compressed == NULL)
+	{
+		struct varlena *slice;
+
+		/* uncompressed external value, so just fetch the missing part */
+		slice = toast_fetch_datum_slice(iter->source, iter->done,
+										target - iter->done);
+		memcpy(VARDATA(iter->buf) + iter->done, VARDATA(slice),
+			   target - iter->done);
+		pfree(slice);
+	}
+	else
+	{
+		if (iter->compressed != iter->source)
+		{
+			int32		hdrsz = TOAST_COMPRESS_HDRSZ - VARHDRSZ;
+			int32		fetched = VARSIZE(iter->compressed) - VARHDRSZ;
+			int32		wanted = iter->compressed_size;
+
+			/*
+			 * For pglz, fetch only as much of the compressed data as the
+			 * target can need.  Until the start of the data has been
+			 * fetched, we can only guess that it's pglz.
+			 */
+			if (fetched == 0 ||
+				TOAST_COMPRESS_METHOD(iter->compressed) == TOAST_PGLZ_COMPRESSION)
+				wanted = pglz_maximum_compressed_size(target,
+										 iter->compressed_size - hdrsz) + hdrsz;
+			if (wanted > fetched)
+				detoast_iterator_fetch(iter, wanted);
+
+			if (TOAST_COMPRESS_METHOD(iter->compressed) != TOAST_PGLZ_COMPRESSION)
+				detoast_iterator_fetch(iter, iter->compressed_size);
+		}
+
+		toast_decompress_prefix(iter->compressed, VARDATA(iter->buf), target);
+	}
+
+	iter->done = target;
+}
+
+/* ----------
+ * detoast_iterator_fetch -
+ *
+ *	Fetch the compressed data of an external value up to offset "upto".
+ * ----------
+ */
+static void
+detoast_iterator_fetch(DetoastIterator iter, int32 upto)
+{
+	int32		fetched = VARSIZE(iter->compressed) - VARHDRSZ;
+	struct varlena *slice;
+
+	if (upto <= fetched)
+		return;
+
+	slice = toast_fetch_datum_slice(iter->source, fetched, upto - fetched);
+	memcpy(VARDATA(iter->compressed) + fetched, VARDATA(slice),
+		   upto - fetched);
+	pfree(slice);
+
+	SET_VARSIZE_COMPRESSED(iter->compressed, upto + VARHDRSZ);
+}
+
+/* ----------
+ * free_detoast_iterator -
+ *
+ *	Release an iterator and the data it detoasted
+ * ----------
+ */
+void
+free_detoast_iterator(DetoastIterator iter)
+{
+	/* an expanded toast value's iterator lives as long as the value */
+	if (iter->shared)
+		return;
+
+	if (iter->buf != iter->source)
+		pfree(iter->buf);
+	if (iter->compressed != NULL && iter->compressed != iter->source)
+		pfree(iter->compressed);
+	pfree(iter);
+}
+
+
+/* ----------
+ * expand_toast_value -
+ *
+ *	Make an expanded toast value standing for the external value "value"
+ *	points to, in a new child context of parentcontext.  Returns a
+ *	read-write pointer to it.
+ * ----------
+ */
+Datum
+expand_toast_value(Datum value, MemoryContext parentcontext)
+{
+	struct varlena *attr = (struct varlena *) DatumGetPointer(value);
+	ExpandedToastValue *etv;
+	MemoryContext objcxt;
+	MemoryContext oldcxt;
+
+	Assert(VARATT_IS_EXTERNAL_ONDISK(attr));
+	Assert(VARSIZE_EXTERNAL(attr) == TOAST_POINTER_SIZE);
+
+	/* the object is small, apart from the detoasted data itself */
+	objcxt = AllocSetContextCreate(parentcontext,
+								   "expanded toast value",
+								   ALLOCSET_SMALL_MINSIZE,
+								   ALLOCSET_SMALL_INITSIZE,
+								   ALLOCSET_DEFAULT_MAXSIZE);
+	oldcxt = MemoryContextSwitchTo(objcxt);
+
+	etv = (ExpandedToastValue *) palloc0(sizeof(ExpandedToastValue));
+	EOH_init_header(&etv->hdr, &ETV_methods, objcxt);
+
+	/* the iterator refers to our copy of the toast pointer */
+	memcpy(etv->toast_pointer, attr, TOAST_POINTER_SIZE);
+	init_detoast_iterator(&etv->iter, (struct varlena *) etv->toast_pointer);
+	etv->iter.shared = true;
+
+	MemoryContextSwitchTo(oldcxt);
+
+	return EOHPGetRWDatum(&etv->hdr);
+}
+
+/* ----------
+ * toast_expanded_source -
+ *
+ *	Return the toast pointer an expanded toast value was made from, so that
+ *	functions that look at how a value is stored, like pg_column_size(),
+ *	see through it.  Any other value is returned as is.
+ * ----------
+ */
+struct varlena *
+toast_expanded_source(struct varlena * attr)
+{
+	ExpandedToastValue *etv = get_expanded_toast_value(attr);
+
+	if (etv != NULL)
+		return (struct varlena *) etv->toast_pointer;
+	return attr;
+}
+
+/*
+ * Return the expanded toast value attr points to, or NULL if it doesn't
+ * point to one.
+ */
+static ExpandedToastValue *
+get_expanded_toast_value(struct varlena * attr)
+{
+	ExpandedObjectHeader *eohptr;
+
+	if (!VARATT_IS_EXTERNAL_EXPANDED(attr))
+		return NULL;
+
+	eohptr = DatumGetEOHP(PointerGetDatum(attr));
+	if (eohptr->eoh_methods != &ETV_methods)
+		return NULL;
+
+	return (ExpandedToastValue *) eohptr;
+}
+
+/*
+ * Expanded object methods of expanded toast values.  The flat form is the
+ * detoasted value, whose size is known without detoasting it.
+ */
+static Size
+ETV_get_flat_size(ExpandedObjectHeader *eohptr)
+{
+	ExpandedToastValue *etv = (ExpandedToastValue *) eohptr;
+
+	return etv->iter.rawsize + VARHDRSZ;
+}
+
+static void
+ETV_flatten_into(ExpandedObjectHeader *eohptr,
+				 void *result, Size allocated_size)
+{
+	ExpandedToastValue *etv = (ExpandedToastValue *) eohptr;
+
+	Assert(allocated_size == etv->iter.rawsize + VARHDRSZ);
+
+	detoast_iterate_to(&etv->iter, etv->iter.rawsize);
+	memcpy(result, etv->iter.buf, allocated_size);
+}
+
+
 /* ----------
  * toast_raw_datum_size -
  *
@@ -434,6 +870,12 @@ toast_datum_size(Datum value)
 	}
 	else if (VARATT_IS_EXTERNAL_EXPANDED(attr))
 	{
+		struct varlena *source = toast_expanded_source(attr);
+
+		/* an expanded toast value is as big as the value it stands for */
+		if (source != attr)
+			return toast_datum_size(PointerGetDatum(source));
+
 		result = EOH_get_flat_size(DatumGetEOHP(value));
 	}
 	else if (VARATT_IS_SHORT(attr))
@@ -772,7 +1214,8 @@ toast_insert_or_update(Relation rel, HeapTuple newtup, HeapTuple oldtup,
 		if (att[i]->attstorage == 'x')
 		{
 			old_value = toast_values[i];
-			new_value = toast_compress_datum(old_value);
+			new_value = toast_compress_datum(old_value,
+								   toast_get_compression_method(rel, i + 1));
 
 			if (DatumGetPointer(new_value) != NULL)
 			{
@@ -911,7 +1354,8 @@ toast_insert_or_update(Relation rel, HeapTuple newtup, HeapTuple oldtup,
 		 */
 		i = biggest_attno;
 		old_value = toast_values[i];
-		new_value = toast_compress_datum(old_value);
+		new_value = toast_compress_datum(old_value,
+								   toast_get_compression_method(rel, i + 1));
 
 		if (DatumGetPointer(new_value) != NULL)
 		{
@@ -1289,7 +1733,8 @@ toast_flatten_tuple_to_datum(HeapTupleHeader tup,
 /* ----------
  * toast_compress_datum -
  *
- *	Create a compressed version of a varlena datum
+ *	Create a compressed version of a varlena datum, using the given
+ *	ToastCompressionMethod
  *
  *	If we fail (ie, compressed result is actually bigger than original)
  *	then return NULL.  We must not use compressed data if it'd expand
@@ -1300,9 +1745,10 @@ toast_flatten_tuple_to_datum(HeapTupleHeader tup,
  * ----------
  */
 Datum
-toast_compress_datum(Datum value)
+toast_compress_datum(Datum value, int method)
 {
 	struct varlena *tmp;
+	char	   *source = VARDATA_ANY(DatumGetPointer(value));
 	int32		valsize = VARSIZE_ANY_EXHDR(DatumGetPointer(value));
 	int32		len;
 
@@ -1321,7 +1767,56 @@ toast_compress_datum(Datum value)
 									TOAST_COMPRESS_HDRSZ);
 
 	/*
-	 * We recheck the actual size even if pglz_compress() reports success,
+	 * lz4 and zstd are told that there's only room for valsize bytes, so
+	 * that they give up early on incompressible data; output that size
+	 * would be rejected below anyway.
+	 */
+	switch (method)
+	{
+		case TOAST_PGLZ_COMPRESSION:
+			len = pglz_compress(source, valsize, TOAST_COMPRESS_RAWDATA(tmp),
+								PGLZ_strategy_default);
+			break;
+
+#ifdef USE_LZ4
+		case TOAST_LZ4_COMPRESSION:
+			len = LZ4_compress_default(source, TOAST_COMPRESS_RAWDATA(tmp),
+									   valsize, valsize);
+			if (len <= 0)
+				len = -1;		/* failure */
+			break;
+#endif
+
+#ifdef USE_ZSTD
+		case TOAST_ZSTD_COMPRESSION:
+			{
+				size_t		zlen;
+
+				if (zstd_cctx == NULL)
+				{
+					zstd_cctx = ZSTD_createCCtx();
+					if (zstd_cctx == NULL)
+						ereport(ERROR,
+								(errcode(ERRCODE_OUT_OF_MEMORY),
+								 errmsg("out of memory")));
+				}
+				zlen = ZSTD_compressCCtx(zstd_cctx,
+										 TOAST_COMPRESS_RAWDATA(tmp), valsize,
+										 source, valsize,
+										 ZSTD_CLEVEL_DEFAULT);
+				len = ZSTD_isError(zlen) ? -1 : (int32) zlen;
+			}
+			break;
+#endif
+
+		default:
+			toast_compression_not_supported(method);
+			len = -1;			/* keep compiler quiet */
+			break;
+	}
+
+	/*
+	 * We recheck the actual size even if the compressor reports success,
 	 * because it might be satisfied with having saved as little as one byte
 	 * in the compressed data --- which could turn into a net loss once you
 	 * consider header and alignment padding.  Worst case, the compressed
@@ -1330,14 +1825,10 @@ toast_compress_datum(Datum value)
 	 * only one header byte and no padding if the value is short enough.  So
 	 * we insist on a savings of more than 2 bytes to ensure we have a gain.
 	 */
-	len = pglz_compress(VARDATA_ANY(DatumGetPointer(value)),
-						valsize,
-						TOAST_COMPRESS_RAWDATA(tmp),
-						PGLZ_strategy_default);
 	if (len >= 0 &&
 		len + TOAST_COMPRESS_HDRSZ < valsize - 2)
 	{
-		TOAST_COMPRESS_SET_RAWSIZE(tmp, valsize);
+		TOAST_COMPRESS_SET_RAWSIZE(tmp, valsize, method);
 		SET_VARSIZE_COMPRESSED(tmp, len + TOAST_COMPRESS_HDRSZ);
 		/* successful compression */
 		return PointerGetDatum(tmp);
@@ -1959,6 +2450,11 @@ toast_fetch_datum(struct varlena * attr)
  *
  *	Reconstruct a segment of a Datum from the chunks saved
  *	in the toast relation
+ *
+ *	For a compressed datum, the segment is of the compressed data.  A
+ *	segment starting at offset zero is returned as a (truncated) compressed
+ *	datum, which can be decompressed as far as it goes; any other segment
+ *	is returned as plain bytes.
  * ----------
  */
 static struct varlena *
@@ -1997,12 +2493,6 @@ toast_fetch_datum_slice(struct varlena * attr, int32 sliceoffset, int32 length)
 	/* Must copy to access aligned fields */
 	VARATT_EXTERNAL_GET_POINTER(toast_pointer, attr);
 
-	/*
-	 * It's nonsense to fetch slices of a compressed datum -- this isn't lo_*
-	 * we can't return a compressed datum which is meaningful to toast later
-	 */
-	Assert(!VARATT_EXTERNAL_IS_COMPRESSED(toast_pointer));
-
 	attrsize = toast_pointer.va_extsize;
 	totalchunks = ((attrsize - 1) / TOAST_MAX_CHUNK_SIZE) + 1;
 
@@ -2017,7 +2507,7 @@ toast_fetch_datum_slice(struct varlena * attr, int32 sliceoffset, int32 length)
 
 	result = (struct varlena *) palloc(length + VARHDRSZ);
 
-	if (VARATT_EXTERNAL_IS_COMPRESSED(toast_pointer))
+	if (VARATT_EXTERNAL_IS_COMPRESSED(toast_pointer) && sliceoffset == 0)
 		SET_VARSIZE_COMPRESSED(result, length + VARHDRSZ);
 	else
 		SET_VARSIZE(result, length + VARHDRSZ);
@@ -2195,22 +2685,307 @@ static struct varlena *
 toast_decompress_datum(struct varlena * attr)
 {
 	struct varlena *result;
+	char	   *source = TOAST_COMPRESS_RAWDATA(attr);
+	int32		srclen = VARSIZE(attr) - TOAST_COMPRESS_HDRSZ;
+	int32		rawsize = TOAST_COMPRESS_RAWSIZE(attr);
+	bool		ok = false;
 
 	Assert(VARATT_IS_COMPRESSED(attr));
 
-	result = (struct varlena *)
-		palloc(TOAST_COMPRESS_RAWSIZE(attr) + VARHDRSZ);
-	SET_VARSIZE(result, TOAST_COMPRESS_RAWSIZE(attr) + VARHDRSZ);
+	result = (struct varlena *) palloc(rawsize + VARHDRSZ);
+	SET_VARSIZE(result, rawsize + VARHDRSZ);
+
+	switch (TOAST_COMPRESS_METHOD(attr))
+	{
+		case TOAST_PGLZ_COMPRESSION:
+			ok = (pglz_decompress(source, srclen,
+								  VARDATA(result), rawsize, true) >= 0);
+			break;
 
-	if (pglz_decompress(TOAST_COMPRESS_RAWDATA(attr),
-						VARSIZE(attr) - TOAST_COMPRESS_HDRSZ,
-						VARDATA(result),
-						TOAST_COMPRESS_RAWSIZE(attr)) < 0)
+#ifdef USE_LZ4
+		case TOAST_LZ4_COMPRESSION:
+			ok = (LZ4_decompress_safe(source, VARDATA(result),
+									  srclen, rawsize) == rawsize);
+			break;
+#endif
+
+#ifdef USE_ZSTD
+		case TOAST_ZSTD_COMPRESSION:
+			{
+				size_t		zlen;
+
+				zlen = ZSTD_decompressDCtx(toast_get_zstd_dctx(),
+										   VARDATA(result), rawsize,
+										   source, srclen);
+				ok = (!ZSTD_isError(zlen) && zlen == (size_t) rawsize);
+			}
+			break;
+#endif
+
+		default:
+			toast_compression_not_supported(TOAST_COMPRESS_METHOD(attr));
+			break;
+	}
+
+	if (!ok)
 		elog(ERROR, "compressed data is corrupted");
 
 	return result;
 }
 
+/* ----------
+ * toast_decompress_datum_slice -
+ *
+ * Decompress the first slicelength bytes of a compressed version of a
+ * varlena datum.  For pglz, attr can be truncated, as long as it holds
+ * pglz_maximum_compressed_size() bytes of compressed data.
+ */
+static struct varlena *
+toast_decompress_datum_slice(struct varlena * attr, int32 slicelength)
+{
+	struct varlena *result;
+
+	Assert(VARATT_IS_COMPRESSED(attr));
+
+	if (slicelength < 0 || slicelength >= TOAST_COMPRESS_RAWSIZE(attr))
+		return toast_decompress_datum(attr);
+
+	result = (struct varlena *) palloc(slicelength + VARHDRSZ);
+	SET_VARSIZE(result, slicelength + VARHDRSZ);
+
+	toast_decompress_prefix(attr, VARDATA(result), slicelength);
+
+	return result;
+}
+
+/* ----------
+ * toast_decompress_prefix -
+ *
+ * Decompress the first prefixlen bytes of a compressed varlena datum into
+ * dest, which must have room for them.  prefixlen mustn't exceed the raw
+ * size of the datum.
+ *
+ * pglz and zstd stop as soon as the prefix is complete.  lz4 may write
+ * past it, but not past dest + prefixlen.
+ */
+static void
+toast_decompress_prefix(struct varlena * attr, char *dest, int32 prefixlen)
+{
+	char	   *source = TOAST_COMPRESS_RAWDATA(attr);
+	int32		srclen = VARSIZE(attr) - TOAST_COMPRESS_HDRSZ;
+	bool		ok = false;
+
+	Assert(VARATT_IS_COMPRESSED(attr));
+	Assert(prefixlen <= TOAST_COMPRESS_RAWSIZE(attr));
+
+	if (prefixlen == 0)
+		return;
+
+	switch (TOAST_COMPRESS_METHOD(attr))
+	{
+		case TOAST_PGLZ_COMPRESSION:
+			ok = (pglz_decompress(source, srclen, dest, prefixlen,
+								  false) == prefixlen);
+			break;
+
+#ifdef USE_LZ4
+		case TOAST_LZ4_COMPRESSION:
+			ok = (LZ4_decompress_safe_partial(source, dest, srclen,
+											  prefixlen, prefixlen) == prefixlen);
+			break;
+#endif
+
+#ifdef USE_ZSTD
+		case TOAST_ZSTD_COMPRESSION:
+			{
+				ZSTD_DCtx  *dctx = toast_get_zstd_dctx();
+				ZSTD_inBuffer in;
+				ZSTD_outBuffer out;
+				size_t		zret;
+
+				ZSTD_DCtx_reset(dctx, ZSTD_reset_session_only);
+				in.src = source;
+				in.size = srclen;
+				in.pos = 0;
+				out.dst = dest;
+				out.size = prefixlen;
+				out.pos = 0;
+
+				/* stop when the prefix is complete, or no progress is made */
+				for (;;)
+				{
+					size_t		inpos = in.pos;
+					size_t		outpos = out.pos;
+
+					zret = ZSTD_decompressStream(dctx, &out, &in);
+					if (ZSTD_isError(zret) || zret == 0 ||
+						out.pos == out.size ||
+						(in.pos == inpos && out.pos == outpos))
+						break;
+				}
+				ok = (!ZSTD_isError(zret) && out.pos == (size_t) prefixlen);
+			}
+			break;
+#endif
+
+		default:
+			toast_compression_not_supported(TOAST_COMPRESS_METHOD(attr));
+			break;
+	}
+
+	if (!ok)
+		elog(ERROR, "compressed data is corrupted");
+}
+
+#ifdef USE_ZSTD
+/* ----------
+ * toast_get_zstd_dctx -
+ *
+ *	Return the backend's zstd decompression context, creating it if needed.
+ */
+static ZSTD_DCtx *
+toast_get_zstd_dctx(void)
+{
+	if (zstd_dctx == NULL)
+	{
+		zstd_dctx = ZSTD_createDCtx();
+		if (zstd_dctx == NULL)
+			ereport(ERROR,
+					(errcode(ERRCODE_OUT_OF_MEMORY),
+					 errmsg("out of memory")));
+	}
+	return zstd_dctx;
+}
+#endif
+
+/* ----------
+ * toast_get_compression_method -
+ *
+ *	Choose the compression method for an attribute of a relation: the
+ *	attribute's "compression" option if it has one, else the default.
+ *	Catalogs always use the default, so that compressing one of their
+ *	tuples needn't look at pg_attribute.
+ */
+static int
+toast_get_compression_method(Relation rel, int attnum)
+{
+	AttributeOpts *opts;
+	int			method = default_toast_compression;
+
+	if (IsCatalogRelation(rel))
+		return method;
+
+	opts = get_attribute_options(RelationGetRelid(rel), attnum);
+	if (opts != NULL)
+	{
+		/*
+		 * The option was validated when it was set, but the server might
+		 * since have been rebuilt without that method; use the default
+		 * then, rather than failing.
+		 */
+		if (opts->compression_offset != 0)
+		{
+			int			m;
+
+			m = toast_compression_method_by_name((char *) opts +
+												 opts->compression_offset);
+			if (m >= 0)
+				method = m;
+		}
+		pfree(opts);
+	}
+
+	return method;
+}
+
+/*
+ * Complain about a compression method that this build doesn't support, or
+ * that isn't a method at all.
+ */
+static void
+toast_compression_not_supported(int method)
+{
+	switch (method)
+	{
+		case TOAST_LZ4_COMPRESSION:
+		case TOAST_ZSTD_COMPRESSION:
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("compression method %s not supported",
+							toast_compression_method_name(method)),
+					 errdetail("This functionality requires the server to be built with %s support.",
+							   toast_compression_method_name(method))));
+			break;
+		default:
+			elog(ERROR, "invalid compression method %d", method);
+			break;
+	}
+}
+
+/* ----------
+ * toast_compression_method_name -
+ *
+ *	Return the name of a ToastCompressionMethod
+ */
+const char *
+toast_compression_method_name(int method)
+{
+	switch (method)
+	{
+		case TOAST_PGLZ_COMPRESSION:
+			return "pglz";
+		case TOAST_LZ4_COMPRESSION:
+			return "lz4";
+		case TOAST_ZSTD_COMPRESSION:
+			return "zstd";
+	}
+	elog(ERROR, "invalid compression method %d", method);
+	return NULL;				/* keep compiler quiet */
+}
+
+/* ----------
+ * toast_compression_method_by_name -
+ *
+ *	Look up a compression method this server supports, by name.  Returns -1
+ *	if there's no such method.
+ */
+int
+toast_compression_method_by_name(const char *name)
+{
+	const struct config_enum_entry *entry;
+
+	for (entry = default_toast_compression_options; entry->name; entry++)
+	{
+		if (pg_strcasecmp(entry->name, name) == 0)
+			return entry->val;
+	}
+	return -1;
+}
+
+/* ----------
+ * toast_validate_compression_option -
+ *
+ *	Validator for the "compression" attribute option
+ */
+void
+toast_validate_compression_option(char *value)
+{
+	if (value != NULL && toast_compression_method_by_name(value) >= 0)
+		return;
+
+	if (value != NULL &&
+		(pg_strcasecmp(value, "lz4") == 0 || pg_strcasecmp(value, "zstd") == 0))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("compression method %s not supported", value),
+				 errdetail("This functionality requires the server to be built with %s support.",
+						   value)));
+
+	ereport(ERROR,
+			(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			 errmsg("invalid value for \"compression\" option")));
+}
+
 
 /* ----------
  * toast_open_indexes
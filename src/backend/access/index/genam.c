@@ -125,6 +125,8 @@ RelationGetIndexScan(Relation indexRelation, int nkeys, int norderbys)
 	scan->xs_cbuf = InvalidBuffer;
 	scan->xs_continue_hot = false;
 
+	scan->parallel_scan = NULL;
+
 	return scan;
 }
 
@@ -174,7 +176,7 @@ BuildIndexValueDescription(Relation indexRelation,
 	StringInfoData buf;
 	Form_pg_index idxrec;
 	HeapTuple	ht_idx;
-	int			natts = indexRelation->rd_rel->relnatts;
+	int			natts = IndexRelationGetNumberOfKeyAttributes(indexRelation);
 	int			i;
 	int			keyno;
 	Oid			indexrelid = RelationGetRelid(indexRelation);
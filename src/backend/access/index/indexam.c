@@ -20,6 +20,9 @@
  *		index_insert	- insert an index tuple into a relation
  *		index_markpos	- mark a scan position
  *		index_restrpos	- restore a scan position
+ *		index_parallelscan_estimate - space needed for a parallel scan
+ *		index_parallelscan_initialize - set up a parallel scan
+ *		index_beginscan_parallel - join a parallel scan of an index
  *		index_getnext_tid	- get the next TID from a scan
  *		index_fetch_heap		- get the scan's next heap tuple
  *		index_getnext	- get the next heap tuple from a scan
@@ -402,6 +405,76 @@ index_markpos(IndexScanDesc scan)
 	FunctionCall1(procedure, PointerGetDatum(scan));
 }
 
+/* ----------------
+ *		index_parallelscan_estimate - estimate shared memory for a parallel
+ *		scan with the given number of participants
+ *
+ * Only valid for AMs that have aminitparallelscan.
+ * ----------------
+ */
+Size
+index_parallelscan_estimate(Relation indexRelation, int nparticipants)
+{
+	FmgrInfo	procedure;
+
+	RELATION_CHECKS;
+	GET_UNCACHED_REL_PROCEDURE(amestimateparallelscan);
+
+	return add_size(MAXALIGN(sizeof(ParallelIndexScanDescData)),
+					(Size) DatumGetInt64(FunctionCall1(&procedure,
+											 Int32GetDatum(nparticipants))));
+}
+
+/* ----------------
+ *		index_parallelscan_initialize - set up the shared state of a
+ *		parallel index scan
+ *
+ * target must have room for index_parallelscan_estimate() bytes.
+ * ----------------
+ */
+void
+index_parallelscan_initialize(Relation heapRelation, Relation indexRelation,
+							  ParallelIndexScanDesc target, int nparticipants)
+{
+	FmgrInfo	procedure;
+
+	RELATION_CHECKS;
+	GET_UNCACHED_REL_PROCEDURE(aminitparallelscan);
+
+	target->ps_relid = RelationGetRelid(heapRelation);
+	target->ps_indexid = RelationGetRelid(indexRelation);
+	target->ps_offset = MAXALIGN(sizeof(ParallelIndexScanDescData));
+
+	FunctionCall2(&procedure,
+				  PointerGetDatum((char *) target + target->ps_offset),
+				  Int32GetDatum(nparticipants));
+}
+
+/* ----------------
+ *		index_beginscan_parallel - start a scan of an index with
+ *		amgettuple, as one of the participants of a parallel scan
+ *
+ * Like index_beginscan, except that the AM coordinates with the other
+ * participants through pscan, so that each returns a share of the tuples.
+ * ----------------
+ */
+IndexScanDesc
+index_beginscan_parallel(Relation heapRelation, Relation indexRelation,
+						 int nkeys, int norderbys, Snapshot snapshot,
+						 ParallelIndexScanDesc pscan)
+{
+	IndexScanDesc scan;
+
+	Assert(RelationGetRelid(heapRelation) == pscan->ps_relid);
+	Assert(RelationGetRelid(indexRelation) == pscan->ps_indexid);
+
+	scan = index_beginscan(heapRelation, indexRelation, snapshot,
+						   nkeys, norderbys);
+	scan->parallel_scan = pscan;
+
+	return scan;
+}
+
 /* ----------------
  *		index_restrpos	- restore a scan position
  *
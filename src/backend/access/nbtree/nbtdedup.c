@@ -0,0 +1,311 @@
+/*-------------------------------------------------------------------------
+ *
+ * nbtdedup.c
+ *	  Merge duplicate leaf items of a btree into posting list tuples.
+ *
+ * An index on a low-cardinality column stores the same key over and over,
+ * once per heap tuple.  Here we replace runs of such duplicates on a leaf
+ * page with posting list tuples, which store the key once followed by the
+ * heap TIDs (see "Posting list tuples" in nbtree.h).  This is done lazily:
+ * only when an insertion finds a page full and would otherwise split it.
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * IDENTIFICATION
+ *	  src/backend/access/nbtree/nbtdedup.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/nbtree.h"
+#include "access/xloginsert.h"
+#include "miscadmin.h"
+#include "storage/bufmgr.h"
+#include "utils/rel.h"
+
+
+static int	_bt_tid_cmp(const void *a, const void *b);
+
+
+/*
+ *	_bt_dedup_one_page() -- merge duplicates on a full leaf page.
+ *
+ * The caller has the buffer exclusive-locked and is about to split the page
+ * for lack of space.  We rewrite the page with each run of items that have
+ * the same key merged into posting list tuples, as far as BTMaxPostingSize
+ * allows.  Returns true if the page was changed, in which case item offsets
+ * on it are no longer what they were.
+ *
+ * Unique indexes are left alone: their duplicates are dead or dying row
+ * versions that VACUUM will soon remove anyway, and _bt_check_unique()
+ * expects to find one heap TID per item.
+ *
+ * Items already marked LP_DEAD are copied unchanged, so that the next
+ * _bt_vacuum_one_page() can still get rid of them.
+ *
+ * The rewritten page is WAL-logged as a full page image.  No heap TIDs are
+ * removed, so there is nothing for Hot Standby to conflict on.
+ */
+bool
+_bt_dedup_one_page(Relation rel, Buffer buf)
+{
+	Page		page = BufferGetPage(buf);
+	BTPageOpaque opaque = (BTPageOpaque) PageGetSpecialPointer(page);
+	Page		newpage;
+	OffsetNumber minoff,
+				maxoff,
+				offnum;
+	Size		maxpostingsize;
+	IndexTuple	base = NULL;
+	Size		basesize = 0;
+	int			nbase = 0;
+	ItemPointer htids;
+	int			nhtids = 0;
+	bool		candidate = false;
+	bool		merged = false;
+
+	Assert(P_ISLEAF(opaque));
+
+	if (rel->rd_index->indisunique)
+		return false;
+
+	minoff = P_FIRSTDATAKEY(opaque);
+	maxoff = PageGetMaxOffsetNumber(page);
+
+	/*
+	 * Look for at least one pair of adjacent items we could merge before
+	 * going to the trouble of building a new page.
+	 */
+	for (offnum = minoff; offnum < maxoff; offnum = OffsetNumberNext(offnum))
+	{
+		ItemId		itemid = PageGetItemId(page, offnum);
+		ItemId		nextid = PageGetItemId(page, OffsetNumberNext(offnum));
+
+		if (!ItemIdIsDead(itemid) && !ItemIdIsDead(nextid) &&
+			_bt_keys_equal((IndexTuple) PageGetItem(page, itemid),
+						   (IndexTuple) PageGetItem(page, nextid)))
+		{
+			candidate = true;
+			break;
+		}
+	}
+	if (!candidate)
+		return false;
+
+	maxpostingsize = BTMaxPostingSize(page);
+	htids = (ItemPointer) palloc(maxpostingsize);
+
+	newpage = PageGetTempPageCopySpecial(page);
+
+	/* the high key, if any, is copied as is */
+	if (!P_RIGHTMOST(opaque))
+	{
+		ItemId		itemid = PageGetItemId(page, P_HIKEY);
+
+		if (PageAddItem(newpage, PageGetItem(page, itemid),
+						ItemIdGetLength(itemid), P_HIKEY,
+						false, false) == InvalidOffsetNumber)
+			elog(ERROR, "failed to add high key to deduplicated page in index \"%s\"",
+				 RelationGetRelationName(rel));
+	}
+
+	/*
+	 * Walk the items in order, accumulating heap TIDs for the current run of
+	 * equal keys in htids[].  Whenever the run ends, emit either the lone
+	 * original item or a posting list tuple covering the whole run.  The
+	 * offset of each emitted item is simply the next one on the new page.
+	 */
+	for (offnum = minoff; offnum <= maxoff + 1; offnum = OffsetNumberNext(offnum))
+	{
+		ItemId		itemid = NULL;
+		IndexTuple	itup = NULL;
+		int			ntids = 0;
+
+		if (offnum <= maxoff)
+		{
+			itemid = PageGetItemId(page, offnum);
+			itup = (IndexTuple) PageGetItem(page, itemid);
+			ntids = BTreeTupleGetNTids(itup);
+
+			/* can this item join the current run? */
+			if (base != NULL && !ItemIdIsDead(itemid) &&
+				_bt_keys_equal(base, itup) &&
+				BTreeTupleGetKeySize(base) +
+				(nhtids + ntids) * sizeof(ItemPointerData) <= maxpostingsize)
+			{
+				if (BTreeTupleIsPosting(itup))
+					memcpy(htids + nhtids, BTreeTupleGetPosting(itup),
+						   ntids * sizeof(ItemPointerData));
+				else
+					htids[nhtids] = itup->t_tid;
+				nhtids += ntids;
+				nbase++;
+				continue;
+			}
+		}
+
+		/* the current run, if any, is complete */
+		if (base != NULL)
+		{
+			IndexTuple	newitup = base;
+			Size		newsize = basesize;
+
+			if (nbase > 1)
+			{
+				qsort(htids, nhtids, sizeof(ItemPointerData), _bt_tid_cmp);
+				newitup = _bt_form_posting(base, htids, nhtids);
+				newsize = IndexTupleSize(newitup);
+				merged = true;
+			}
+
+			if (PageAddItem(newpage, (Item) newitup, newsize,
+							OffsetNumberNext(PageGetMaxOffsetNumber(newpage)),
+							false, false) == InvalidOffsetNumber)
+				elog(ERROR, "failed to add posting list tuple to index \"%s\"",
+					 RelationGetRelationName(rel));
+
+			if (newitup != base)
+				pfree(newitup);
+			base = NULL;
+		}
+
+		if (itup == NULL)
+			break;
+
+		if (ItemIdIsDead(itemid))
+		{
+			OffsetNumber newoff;
+
+			newoff = PageAddItem(newpage, (Item) itup, ItemIdGetLength(itemid),
+							 OffsetNumberNext(PageGetMaxOffsetNumber(newpage)),
+								 false, false);
+			if (newoff == InvalidOffsetNumber)
+				elog(ERROR, "failed to add item to deduplicated page in index \"%s\"",
+					 RelationGetRelationName(rel));
+			ItemIdMarkDead(PageGetItemId(newpage, newoff));
+			continue;
+		}
+
+		/* start a new run with this item */
+		base = itup;
+		basesize = ItemIdGetLength(itemid);
+		nbase = 1;
+		if (BTreeTupleIsPosting(itup))
+			memcpy(htids, BTreeTupleGetPosting(itup),
+				   ntids * sizeof(ItemPointerData));
+		else
+			htids[0] = itup->t_tid;
+		nhtids = ntids;
+	}
+
+	pfree(htids);
+
+	if (!merged)
+	{
+		pfree(newpage);
+		return false;
+	}
+
+	/* No ereport(ERROR) until changes are logged */
+	START_CRIT_SECTION();
+
+	PageRestoreTempPage(newpage, page);
+	MarkBufferDirty(buf);
+
+	if (RelationNeedsWAL(rel))
+		log_newpage_buffer(buf, true);
+
+	END_CRIT_SECTION();
+
+	return true;
+}
+
+/*
+ *	_bt_keys_equal() -- do two leaf items carry bitwise identical keys?
+ *
+ * This is stricter than the opclass's notion of equality (numeric 1.0 and
+ * 1.00 compare equal, but aren't stored the same way), which is what we
+ * want: items that share a posting list share a single copy of the key, and
+ * index-only scans must return each row's own key.  Either item may be a
+ * posting list tuple.
+ */
+bool
+_bt_keys_equal(IndexTuple a, IndexTuple b)
+{
+	Size		keysize = BTreeTupleGetKeySize(a);
+
+	if (keysize != BTreeTupleGetKeySize(b))
+		return false;
+	if ((a->t_info & (INDEX_NULL_MASK | INDEX_VAR_MASK)) !=
+		(b->t_info & (INDEX_NULL_MASK | INDEX_VAR_MASK)))
+		return false;
+
+	return memcmp((char *) a + sizeof(IndexTupleData),
+				  (char *) b + sizeof(IndexTupleData),
+				  keysize - sizeof(IndexTupleData)) == 0;
+}
+
+/*
+ *	_bt_form_posting() -- build a leaf item with base's key and given TIDs.
+ *
+ * With more than one TID the result is a posting list tuple, otherwise an
+ * ordinary item pointing at htids[0].  The TIDs must already be sorted.
+ * The result is palloc'd.
+ */
+IndexTuple
+_bt_form_posting(IndexTuple base, ItemPointer htids, int nhtids)
+{
+	Size		keysize = BTreeTupleGetKeySize(base);
+	Size		newsize;
+	IndexTuple	itup;
+
+	Assert(nhtids > 0);
+
+	if (nhtids > 1)
+		newsize = MAXALIGN(keysize + nhtids * sizeof(ItemPointerData));
+	else
+		newsize = keysize;
+	Assert(newsize <= INDEX_SIZE_MASK);
+
+	itup = (IndexTuple) palloc0(newsize);
+	memcpy(itup, base, keysize);
+	itup->t_info &= ~(INDEX_SIZE_MASK | BT_IS_POSTING);
+	itup->t_info |= newsize;
+
+	if (nhtids > 1)
+	{
+		BTreeTupleSetPosting(itup, nhtids, keysize);
+		memcpy(BTreeTupleGetPosting(itup), htids,
+			   nhtids * sizeof(ItemPointerData));
+	}
+	else
+		itup->t_tid = htids[0];
+
+	return itup;
+}
+
+/*
+ *	_bt_key_copy() -- copy a leaf item, dropping its posting list if any.
+ *
+ * Used where a leaf item is copied to become a high key or a downlink,
+ * neither of which has any use for the heap TIDs.
+ */
+IndexTuple
+_bt_key_copy(IndexTuple itup)
+{
+	if (!BTreeTupleIsPosting(itup))
+		return CopyIndexTuple(itup);
+
+	return _bt_form_posting(itup, BTreeTupleGetPosting(itup), 1);
+}
+
+/*
+ * qsort comparator for heap TIDs
+ */
+static int
+_bt_tid_cmp(const void *a, const void *b)
+{
+	return ItemPointerCompare((ItemPointer) a, (ItemPointer) b);
+}
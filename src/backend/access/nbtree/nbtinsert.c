@@ -108,7 +108,7 @@ _bt_doinsert(Relation rel, IndexTuple itup,
 			 IndexUniqueCheck checkUnique, Relation heapRel)
 {
 	bool		is_unique = false;
-	int			natts = rel->rd_rel->relnatts;
+	int			natts = IndexRelationGetNumberOfKeyAttributes(rel);
 	ScanKey		itup_scankey;
 	BTStack		stack;
 	Buffer		buf;
@@ -242,7 +242,7 @@ _bt_check_unique(Relation rel, IndexTuple itup, Relation heapRel,
 				 uint32 *speculativeToken)
 {
 	TupleDesc	itupdesc = RelationGetDescr(rel);
-	int			natts = rel->rd_rel->relnatts;
+	int			natts = IndexRelationGetNumberOfKeyAttributes(rel);
 	SnapshotData SnapshotDirty;
 	OffsetNumber maxoff;
 	Page		page;
@@ -622,7 +622,16 @@ _bt_findinsertloc(Relation rel,
 		if (P_RIGHTMOST(lpageop) ||
 			_bt_compare(rel, keysz, scankey, page, P_HIKEY) != 0 ||
 			random() <= (MAX_RANDOM_VALUE / 100))
+		{
+			/*
+			 * We'll have to split this page, unless merging its duplicates
+			 * into posting lists frees enough space.  Like vacuuming, that
+			 * moves items around, so the caller's hint is no longer valid.
+			 */
+			if (P_ISLEAF(lpageop) && _bt_dedup_one_page(rel, buf))
+				vacuumed = true;
 			break;
+		}
 
 		/*
 		 * step right to next non-dead page
@@ -830,9 +839,11 @@ _bt_insertonpg(Relation rel,
 		/* Do the update.  No ereport(ERROR) until changes are logged */
 		START_CRIT_SECTION();
 
+		_bt_page_change_begin(page);
 		if (!_bt_pgaddtup(page, itemsz, itup, newitemoff))
 			elog(PANIC, "failed to add new item to block %u in index \"%s\"",
 				 itup_blkno, RelationGetRelationName(rel));
+		_bt_page_change_end(page);
 
 		MarkBufferDirty(buf);
 
@@ -1024,9 +1035,19 @@ _bt_split(Relation rel, Buffer buf, Buffer cbuf, OffsetNumber firstright,
 	ropaque->btpo_prev = origpagenumber;
 	ropaque->btpo_next = oopaque->btpo_next;
 	lopaque->btpo.level = ropaque->btpo.level = oopaque->btpo.level;
-	/* Since we already have write-lock on both pages, ok to read cycleid */
-	lopaque->btpo_cycleid = _bt_vacuum_cycleid(rel);
-	ropaque->btpo_cycleid = lopaque->btpo_cycleid;
+	/*
+	 * Since we already have write-lock on both pages, ok to read cycleid.
+	 * Internal pages use the field as a change counter instead: the new
+	 * right page starts from zero, and the left page takes over the
+	 * original's counter below.
+	 */
+	if (isleaf)
+	{
+		lopaque->btpo_cycleid = _bt_vacuum_cycleid(rel);
+		ropaque->btpo_cycleid = lopaque->btpo_cycleid;
+	}
+	else
+		lopaque->btpo_cycleid = ropaque->btpo_cycleid = 0;
 
 	/*
 	 * If the page we're splitting is not the rightmost page at its level in
@@ -1072,6 +1093,30 @@ _bt_split(Relation rel, Buffer buf, Buffer cbuf, OffsetNumber firstright,
 		itemsz = ItemIdGetLength(itemid);
 		item = (IndexTuple) PageGetItem(origpage, itemid);
 	}
+
+	/*
+	 * On the leaf level, the high key need only separate the last item on the
+	 * left from the first item on the right, so cut it down to as few key
+	 * attributes as will do that.  It becomes the downlink for the right
+	 * page too, so this keeps internal pages from filling up with key
+	 * attributes nobody needs.  On upper levels, the first key on the right
+	 * is already a pivot tuple, and is copied as is.
+	 */
+	if (isleaf)
+	{
+		IndexTuple	lastleft;
+
+		if (newitemonleft && newitemoff == firstright)
+			lastleft = newitem;
+		else
+		{
+			itemid = PageGetItemId(origpage, OffsetNumberPrev(firstright));
+			lastleft = (IndexTuple) PageGetItem(origpage, itemid);
+		}
+
+		item = _bt_truncate(rel, lastleft, item);
+		itemsz = IndexTupleSize(item);
+	}
 	if (PageAddItem(leftpage, (Item) item, itemsz, leftoff,
 					false, false) == InvalidOffsetNumber)
 	{
@@ -1229,8 +1274,15 @@ _bt_split(Relation rel, Buffer buf, Buffer cbuf, OffsetNumber firstright,
 	 *
 	 * We need to do this before writing the WAL record, so that XLogInsert
 	 * can WAL log an image of the page if necessary.
+	 *
+	 * Give the new left page the odd change counter that the original has
+	 * for the duration, so that it doesn't flicker during the copy.
 	 */
+	_bt_page_change_begin(origpage);
+	if (!isleaf)
+		lopaque->btpo_cycleid = oopaque->btpo_cycleid;
 	PageRestoreTempPage(leftpage, origpage);
+	_bt_page_change_end(origpage);
 	/* leftpage, lopaque must not be used below here */
 
 	MarkBufferDirty(buf);
@@ -1289,20 +1341,17 @@ _bt_split(Relation rel, Buffer buf, Buffer cbuf, OffsetNumber firstright,
 		if (newitemonleft)
 			XLogRegisterBufData(0, (char *) newitem, MAXALIGN(newitemsz));
 
-		/* Log left page */
-		if (!isleaf)
-		{
-			/*
-			 * We must also log the left page's high key, because the right
-			 * page's leftmost key is suppressed on non-leaf levels.  Show it
-			 * as belonging to the left page buffer, so that it is not stored
-			 * if XLogInsert decides it needs a full-page image of the left
-			 * page.
-			 */
-			itemid = PageGetItemId(origpage, P_HIKEY);
-			item = (IndexTuple) PageGetItem(origpage, itemid);
-			XLogRegisterBufData(0, (char *) item, MAXALIGN(IndexTupleSize(item)));
-		}
+		/*
+		 * Log left page's high key.  It can't be reconstructed from the right
+		 * page: the right page's leftmost key is suppressed on non-leaf
+		 * levels, and on the leaf level the high key is a truncated copy of
+		 * it.  Show it as belonging to the left page buffer, so that it is
+		 * not stored if XLogInsert decides it needs a full-page image of the
+		 * left page.
+		 */
+		itemid = PageGetItemId(origpage, P_HIKEY);
+		item = (IndexTuple) PageGetItem(origpage, itemid);
+		XLogRegisterBufData(0, (char *) item, MAXALIGN(IndexTupleSize(item)));
 
 		/*
 		 * Log the contents of the right page in the format understood by
@@ -1687,7 +1736,7 @@ _bt_insert_parent(Relation rel,
 
 		/* form an index tuple that points at the new right page */
 		new_item = CopyIndexTuple(ritem);
-		ItemPointerSet(&(new_item->t_tid), rbknum, P_HIKEY);
+		BTreeTupleSetDownLink(new_item, rbknum);
 
 		/*
 		 * Find the parent buffer and get the parent page.
@@ -1962,7 +2011,7 @@ _bt_newroot(Relation rel, Buffer lbuf, Buffer rbuf)
 	right_item_sz = ItemIdGetLength(itemid);
 	item = (IndexTuple) PageGetItem(lpage, itemid);
 	right_item = CopyIndexTuple(item);
-	ItemPointerSet(&(right_item->t_tid), rbkno, P_HIKEY);
+	BTreeTupleSetDownLink(right_item, rbkno);
 
 	/* NO EREPORT(ERROR) from here till newroot op is logged */
 	START_CRIT_SECTION();
@@ -2112,14 +2161,23 @@ static bool
 _bt_isequal(TupleDesc itupdesc, Page page, OffsetNumber offnum,
 			int keysz, ScanKey scankey)
 {
+	BTPageOpaque opaque = (BTPageOpaque) PageGetSpecialPointer(page);
 	IndexTuple	itup;
 	int			i;
 
 	/* Better be comparing to a leaf item */
-	Assert(P_ISLEAF((BTPageOpaque) PageGetSpecialPointer(page)));
+	Assert(P_ISLEAF(opaque));
 
 	itup = (IndexTuple) PageGetItem(page, PageGetItemId(page, offnum));
 
+	/*
+	 * A truncated high key can't be equal to a complete key: anything that
+	 * matches all of its remaining attributes sorts after it.
+	 */
+	if (offnum < P_FIRSTDATAKEY(opaque) && BTreeTupleIsTruncated(itup) &&
+		ItemPointerGetOffsetNumber(&(itup->t_tid)) < keysz)
+		return false;
+
 	for (i = 1; i <= keysz; i++)
 	{
 		AttrNumber	attno;
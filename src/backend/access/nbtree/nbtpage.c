@@ -27,6 +27,7 @@
 #include "access/xlog.h"
 #include "access/xloginsert.h"
 #include "miscadmin.h"
+#include "port/atomics.h"
 #include "storage/indexfsm.h"
 #include "storage/lmgr.h"
 #include "storage/predicate.h"
@@ -764,6 +765,98 @@ _bt_page_recyclable(Page page)
 	return false;
 }
 
+/*
+ * Internal pages keep a change counter in btpo_cycleid; see nbtree.h.  It
+ * stays within the range of cycle IDs, and MAX_BT_CYCLE_ID + 1 is even, so
+ * wrapping around doesn't upset the odd/even convention.
+ */
+#define BT_NEXT_CHANGE_COUNT(c)	(((c) + 1) % (MAX_BT_CYCLE_ID + 1))
+
+/* Give up on an unlocked read after this many tries */
+#define BT_UNLOCKED_READ_TRIES	3
+
+/*
+ *	_bt_page_change_begin() -- Announce a change to an internal page.
+ *
+ * The caller must hold an exclusive lock on the buffer, and call
+ * _bt_page_change_end() once the change is complete.  These are no-ops on
+ * leaf pages, which are never read without a lock.
+ *
+ * A counter that is already odd can only have been left so by a split or
+ * VACUUM before the counter was introduced, so we step it twice.
+ */
+void
+_bt_page_change_begin(Page page)
+{
+	BTPageOpaque opaque = (BTPageOpaque) PageGetSpecialPointer(page);
+
+	if (P_ISLEAF(opaque))
+		return;
+
+	opaque->btpo_cycleid = BT_NEXT_CHANGE_COUNT(opaque->btpo_cycleid);
+	if (!(opaque->btpo_cycleid & 1))
+		opaque->btpo_cycleid = BT_NEXT_CHANGE_COUNT(opaque->btpo_cycleid);
+	pg_write_barrier();
+}
+
+/*
+ *	_bt_page_change_end() -- Finish a change begun by _bt_page_change_begin().
+ */
+void
+_bt_page_change_end(Page page)
+{
+	BTPageOpaque opaque = (BTPageOpaque) PageGetSpecialPointer(page);
+
+	if (P_ISLEAF(opaque))
+		return;
+
+	pg_write_barrier();
+	Assert(opaque->btpo_cycleid & 1);
+	opaque->btpo_cycleid = BT_NEXT_CHANGE_COUNT(opaque->btpo_cycleid);
+}
+
+/*
+ *	_bt_page_copy_unlocked() -- Copy a pinned but unlocked page.
+ *
+ * Returns true if 'copy' (BLCKSZ bytes) now holds a consistent image of an
+ * internal page, or of a leaf page.  Only the flags of a leaf page can be
+ * trusted, though, since leaf pages don't keep the change counter.  Returns
+ * false if the page kept changing under us, or doesn't look like a btree
+ * page; the caller should then lock the buffer and try again.
+ *
+ * The special space of a btree page is always in the same place, so we can
+ * find the counter without trusting anything else on the page.
+ */
+bool
+_bt_page_copy_unlocked(Buffer buf, Page copy)
+{
+	Page		page = BufferGetPage(buf);
+	volatile BTPageOpaqueData *opaque;
+	int			tries;
+
+	opaque = (volatile BTPageOpaqueData *)
+		((char *) page + BLCKSZ - MAXALIGN(sizeof(BTPageOpaqueData)));
+
+	for (tries = 0; tries < BT_UNLOCKED_READ_TRIES; tries++)
+	{
+		BTCycleId	before = opaque->btpo_cycleid;
+
+		/* a change is in progress */
+		if (before & 1)
+			continue;
+
+		pg_read_barrier();
+		memcpy(copy, page, BLCKSZ);
+		pg_read_barrier();
+
+		if (opaque->btpo_cycleid == before)
+			return !PageIsNew(copy) &&
+				PageGetSpecialSize(copy) == MAXALIGN(sizeof(BTPageOpaqueData));
+	}
+
+	return false;
+}
+
 /*
  * Delete item(s) from a btree page during VACUUM.
  *
@@ -774,6 +867,11 @@ _bt_page_recyclable(Page page)
  * This routine assumes that the caller has pinned and locked the buffer.
  * Also, the given itemnos *must* appear in increasing order in the array.
  *
+ * updatable[] and updated[] list posting list tuples that lose some but not
+ * all of their heap TIDs, and their replacements.  Each replacement is put
+ * at the same offset as the tuple it replaces, before any items are
+ * deleted.
+ *
  * We record VACUUMs and b-tree deletes differently in WAL. InHotStandby
  * we need to be able to pin all of the blocks in the btree in physical
  * order when replaying the effects of a VACUUM, just as we do for the
@@ -787,15 +885,23 @@ _bt_page_recyclable(Page page)
 void
 _bt_delitems_vacuum(Relation rel, Buffer buf,
 					OffsetNumber *itemnos, int nitems,
-					BlockNumber lastBlockVacuumed)
+					OffsetNumber *updatable, IndexTuple *updated,
+					int nupdatable, BlockNumber lastBlockVacuumed)
 {
 	Page		page = BufferGetPage(buf);
 	BTPageOpaque opaque;
+	int			i;
+
+	/* each replacement tuple is a separate rdata entry */
+	if (nupdatable > 0 && RelationNeedsWAL(rel))
+		XLogEnsureRecordSpace(0, 3 + nupdatable);
 
 	/* No ereport(ERROR) until changes are logged */
 	START_CRIT_SECTION();
 
 	/* Fix the page */
+	for (i = 0; i < nupdatable; i++)
+		_bt_replace_item(page, updatable[i], updated[i]);
 	if (nitems > 0)
 		PageIndexMultiDelete(page, itemnos, nitems);
 
@@ -824,6 +930,7 @@ _bt_delitems_vacuum(Relation rel, Buffer buf,
 		xl_btree_vacuum xlrec_vacuum;
 
 		xlrec_vacuum.lastBlockVacuumed = lastBlockVacuumed;
+		xlrec_vacuum.nupdated = nupdatable;
 
 		XLogBeginInsert();
 		XLogRegisterBuffer(0, buf, REGBUF_STANDARD);
@@ -832,8 +939,16 @@ _bt_delitems_vacuum(Relation rel, Buffer buf,
 		/*
 		 * The target-offsets array is not in the buffer, but pretend that it
 		 * is.  When XLogInsert stores the whole buffer, the offsets array
-		 * need not be stored too.
+		 * need not be stored too.  Likewise for the replacement tuples.
 		 */
+		if (nupdatable > 0)
+		{
+			XLogRegisterBufData(0, (char *) updatable,
+								nupdatable * sizeof(OffsetNumber));
+			for (i = 0; i < nupdatable; i++)
+				XLogRegisterBufData(0, (char *) updated[i],
+									MAXALIGN(IndexTupleSize(updated[i])));
+		}
 		if (nitems > 0)
 			XLogRegisterBufData(0, (char *) itemnos, nitems * sizeof(OffsetNumber));
 
@@ -845,6 +960,23 @@ _bt_delitems_vacuum(Relation rel, Buffer buf,
 	END_CRIT_SECTION();
 }
 
+/*
+ * Replace the item at offnum on a leaf page with a smaller one, keeping its
+ * offset.  Used when VACUUM removes some of the heap TIDs of a posting list
+ * tuple; shared with WAL replay.
+ */
+void
+_bt_replace_item(Page page, OffsetNumber offnum, IndexTuple itup)
+{
+	Size		itemsz = MAXALIGN(IndexTupleSize(itup));
+
+	PageIndexTupleDelete(page, offnum);
+	if (PageAddItem(page, (Item) itup, itemsz, offnum,
+					false, false) == InvalidOffsetNumber)
+		elog(PANIC, "failed to replace posting list tuple at offset %u",
+			 offnum);
+}
+
 /*
  * Delete item(s) from a btree page during single-page cleanup.
  *
@@ -1203,6 +1335,7 @@ _bt_pagedel(Relation rel, Buffer buf)
 			if (!stack)
 			{
 				ScanKey		itup_scankey;
+				int			keysz;
 				ItemId		itemid;
 				IndexTuple	targetkey;
 				Buffer		lbuf;
@@ -1252,9 +1385,9 @@ _bt_pagedel(Relation rel, Buffer buf)
 				}
 
 				/* we need an insertion scan key for the search, so build one */
-				itup_scankey = _bt_mkscankey(rel, targetkey);
+				itup_scankey = _bt_mkscankey_pivot(rel, targetkey, &keysz);
 				/* find the leftmost leaf page containing this key */
-				stack = _bt_search(rel, rel->rd_rel->relnatts, itup_scankey,
+				stack = _bt_search(rel, keysz, itup_scankey,
 								   false, &lbuf, BT_READ);
 				/* don't need a pin on the page */
 				_bt_relbuf(rel, lbuf);
@@ -1420,13 +1553,17 @@ _bt_mark_page_halfdead(Relation rel, Buffer leafbuf, BTStack stack)
 	page = BufferGetPage(topparent);
 	opaque = (BTPageOpaque) PageGetSpecialPointer(page);
 
+	_bt_page_change_begin(page);
+
 	itemid = PageGetItemId(page, topoff);
 	itup = (IndexTuple) PageGetItem(page, itemid);
-	ItemPointerSet(&(itup->t_tid), rightsib, P_HIKEY);
+	BTreeTupleSetDownLink(itup, rightsib);
 
 	nextoffset = OffsetNumberNext(topoff);
 	PageIndexTupleDelete(page, nextoffset);
 
+	_bt_page_change_end(page);
+
 	/*
 	 * Mark the leaf page as half-dead, and stamp it with a pointer to the
 	 * highest internal page in the branch we're deleting.  We use the tid of
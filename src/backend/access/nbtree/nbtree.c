@@ -23,30 +23,18 @@
 #include "access/xlog.h"
 #include "catalog/index.h"
 #include "commands/vacuum.h"
+#include "miscadmin.h"
+#include "pgstat.h"
 #include "storage/indexfsm.h"
 #include "storage/ipc.h"
 #include "storage/lmgr.h"
+#include "storage/proc.h"
 #include "storage/smgr.h"
+#include "storage/spin.h"
 #include "tcop/tcopprot.h"
 #include "utils/memutils.h"
 
 
-/* Working state for btbuild and its callback */
-typedef struct
-{
-	bool		isUnique;
-	bool		haveDead;
-	Relation	heapRel;
-	BTSpool    *spool;
-
-	/*
-	 * spool2 is needed only when the index is a unique index. Dead tuples are
-	 * put into spool2 instead of spool in order to avoid uniqueness check.
-	 */
-	BTSpool    *spool2;
-	double		indtuples;
-} BTBuildState;
-
 /* Working state needed by btvacuumpage */
 typedef struct
 {
@@ -61,131 +49,54 @@ typedef struct
 	MemoryContext pagedelcontext;
 } BTVacState;
 
-
-static void btbuildCallback(Relation index,
-				HeapTuple htup,
-				Datum *values,
-				bool *isnull,
-				bool tupleIsAlive,
-				void *state);
-static void btvacuumscan(IndexVacuumInfo *info, IndexBulkDeleteResult *stats,
-			 IndexBulkDeleteCallback callback, void *callback_state,
-			 BTCycleId cycleid);
-static void btvacuumpage(BTVacState *vstate, BlockNumber blkno,
-			 BlockNumber orig_blkno);
-
-
 /*
- *	btbuild() -- build a new btree index.
+ * Shared state of a parallel btree scan, which follows the
+ * ParallelIndexScanDescData in dynamic shared memory.
+ *
+ * The participants read the leaf pages in turn, going right: whoever is
+ * ready first seizes the scan, reads the next page's right-link, and
+ * releases the scan with that as the next page before going through the
+ * page's tuples, so that the next participant can go on meanwhile.  While
+ * the scan is seized (BTPARALLEL_ADVANCING), the others wait for it; the
+ * first participant to seize it descends the tree to find the starting
+ * page.  Once somebody finds that the rest of the index can't match, or
+ * reaches the rightmost page, the scan is done.
  */
-Datum
-btbuild(PG_FUNCTION_ARGS)
+typedef enum
 {
-	Relation	heap = (Relation) PG_GETARG_POINTER(0);
-	Relation	index = (Relation) PG_GETARG_POINTER(1);
-	IndexInfo  *indexInfo = (IndexInfo *) PG_GETARG_POINTER(2);
-	IndexBuildResult *result;
-	double		reltuples;
-	BTBuildState buildstate;
-
-	buildstate.isUnique = indexInfo->ii_Unique;
-	buildstate.haveDead = false;
-	buildstate.heapRel = heap;
-	buildstate.spool = NULL;
-	buildstate.spool2 = NULL;
-	buildstate.indtuples = 0;
-
-#ifdef BTREE_BUILD_STATS
-	if (log_btree_build_stats)
-		ResetUsage();
-#endif   /* BTREE_BUILD_STATS */
+	BTPARALLEL_NOT_INITIALIZED,
+	BTPARALLEL_ADVANCING,
+	BTPARALLEL_IDLE,
+	BTPARALLEL_DONE
+} BTPS_State;
 
-	/*
-	 * We expect to be called exactly once for any index relation. If that's
-	 * not the case, big trouble's what we have.
-	 */
-	if (RelationGetNumberOfBlocks(index) != 0)
-		elog(ERROR, "index \"%s\" already contains data",
-			 RelationGetRelationName(index));
-
-	buildstate.spool = _bt_spoolinit(heap, index, indexInfo->ii_Unique, false);
-
-	/*
-	 * If building a unique index, put dead tuples in a second spool to keep
-	 * them out of the uniqueness check.
-	 */
-	if (indexInfo->ii_Unique)
-		buildstate.spool2 = _bt_spoolinit(heap, index, false, true);
-
-	/* do the heap scan */
-	reltuples = IndexBuildHeapScan(heap, index, indexInfo, true,
-								   btbuildCallback, (void *) &buildstate);
-
-	/* okay, all heap tuples are indexed */
-	if (buildstate.spool2 && !buildstate.haveDead)
-	{
-		/* spool2 turns out to be unnecessary */
-		_bt_spooldestroy(buildstate.spool2);
-		buildstate.spool2 = NULL;
-	}
-
-	/*
-	 * Finish the build by (1) completing the sort of the spool file, (2)
-	 * inserting the sorted tuples into btree pages and (3) building the upper
-	 * levels.
-	 */
-	_bt_leafbuild(buildstate.spool, buildstate.spool2);
-	_bt_spooldestroy(buildstate.spool);
-	if (buildstate.spool2)
-		_bt_spooldestroy(buildstate.spool2);
-
-#ifdef BTREE_BUILD_STATS
-	if (log_btree_build_stats)
-	{
-		ShowUsage("BTREE BUILD STATS");
-		ResetUsage();
-	}
-#endif   /* BTREE_BUILD_STATS */
-
-	/*
-	 * Return statistics
-	 */
-	result = (IndexBuildResult *) palloc(sizeof(IndexBuildResult));
+typedef struct BTParallelScanDescData
+{
+	slock_t		btps_mutex;		/* protects all of the below */
+	BTPS_State	btps_pageStatus;	/* see above */
+	BlockNumber btps_scanPage;	/* next page to read, when IDLE */
+	int			btps_nwaiters;	/* number of valid entries in waiters[] */
+	int			btps_maxwaiters;	/* allocated length of waiters[] */
+	int			btps_waiters[FLEXIBLE_ARRAY_MEMBER];	/* pgprocnos */
+} BTParallelScanDescData;
 
-	result->heap_tuples = reltuples;
-	result->index_tuples = buildstate.indtuples;
+typedef struct BTParallelScanDescData *BTParallelScanDesc;
 
-	PG_RETURN_POINTER(result);
-}
+#define BTParallelScanGetState(pscan) \
+	((BTParallelScanDesc) ((char *) (pscan) + (pscan)->ps_offset))
 
-/*
- * Per-tuple callback from IndexBuildHeapScan
- */
-static void
-btbuildCallback(Relation index,
-				HeapTuple htup,
-				Datum *values,
-				bool *isnull,
-				bool tupleIsAlive,
-				void *state)
-{
-	BTBuildState *buildstate = (BTBuildState *) state;
 
-	/*
-	 * insert the index tuple into the appropriate spool file for subsequent
-	 * processing
-	 */
-	if (tupleIsAlive || buildstate->spool2 == NULL)
-		_bt_spool(buildstate->spool, &htup->t_self, values, isnull);
-	else
-	{
-		/* dead tuples are put into spool2 */
-		buildstate->haveDead = true;
-		_bt_spool(buildstate->spool2, &htup->t_self, values, isnull);
-	}
+static void btvacuumscan(IndexVacuumInfo *info, IndexBulkDeleteResult *stats,
+			 IndexBulkDeleteCallback callback, void *callback_state,
+			 BTCycleId cycleid);
+static void btvacuumpage(BTVacState *vstate, BlockNumber blkno,
+			 BlockNumber orig_blkno);
+static IndexTuple btvacuumposting(IndexTuple itup,
+				IndexBulkDeleteCallback callback, void *callback_state,
+				int *nremaining);
+static void _bt_parallel_set_status(BTParallelScanDesc btscan,
+						BTPS_State status, BlockNumber scan_page);
 
-	buildstate->indtuples += 1;
-}
 
 /*
  *	btbuildempty() -- build an empty btree index in the initialization fork
@@ -261,6 +172,11 @@ btgettuple(PG_FUNCTION_ARGS)
 	/* btree indexes are never lossy */
 	scan->xs_recheck = false;
 
+	/* the planner doesn't make parallel scans that need these */
+	if (scan->parallel_scan != NULL &&
+		(so->numArrayKeys != 0 || ScanDirectionIsBackward(dir)))
+		elog(ERROR, "parallel btree scans must be forward and without array keys");
+
 	/*
 	 * If we have any array keys, initialize them during first call for a
 	 * scan.  We can't do this in btrescan because we don't know the scan
@@ -284,7 +200,8 @@ btgettuple(PG_FUNCTION_ARGS)
 		 * _bt_first() to get the first item in the scan.
 		 */
 		if (!BTScanPosIsValid(so->currPos))
-			res = _bt_first(scan, dir);
+			res = so->skipScan ? _bt_skip_first(scan, dir) :
+				_bt_first(scan, dir);
 		else
 		{
 			/*
@@ -303,20 +220,45 @@ btgettuple(PG_FUNCTION_ARGS)
 				 */
 				if (so->killedItems == NULL)
 					so->killedItems = (int *)
-						palloc(MaxIndexTuplesPerPage * sizeof(int));
-				if (so->numKilled < MaxIndexTuplesPerPage)
+						palloc(MaxTIDsPerBTreePage * sizeof(int));
+				if (so->numKilled < MaxTIDsPerBTreePage)
 					so->killedItems[so->numKilled++] = so->currPos.itemIndex;
 			}
 
 			/*
-			 * Now continue the scan.
+			 * _bt_first() stops checking a bound key once it knows the key
+			 * holds for the rest of the scan, which is only true in the
+			 * direction the scan started in.  If a skip scan in
+			 * BT_SKIP_BOUND state has turned around, we need the key
+			 * checked so the scan stops at the bound.
+			 */
+			if (so->skipScan && so->skipState == BT_SKIP_BOUND &&
+				dir != so->skipDir)
+			{
+				int			i;
+
+				for (i = 0; i < so->numberOfKeys; i++)
+				{
+					if (so->keyData[i].sk_attno == 1)
+						so->keyData[i].sk_flags &= ~SK_BT_MATCHED;
+				}
+			}
+
+			/*
+			 * Now continue the scan.  In a skip scan, once the current
+			 * leading column value is used up, go on to the next one.
 			 */
 			res = _bt_next(scan, dir);
+			if (!res && so->skipScan)
+				res = _bt_skip_first(scan, dir);
 		}
 
 		/* If we have a tuple, return it ... */
 		if (res)
+		{
+			_bt_prefetch_heap(scan, dir);
 			break;
+		}
 		/* ... otherwise see if we have more array keys to deal with */
 	} while (so->numArrayKeys && _bt_advance_array_keys(scan, dir));
 
@@ -351,7 +293,8 @@ btgetbitmap(PG_FUNCTION_ARGS)
 	do
 	{
 		/* Fetch the first page & tuple */
-		if (_bt_first(scan, ForwardScanDirection))
+		if (so->skipScan ? _bt_skip_first(scan, ForwardScanDirection) :
+			_bt_first(scan, ForwardScanDirection))
 		{
 			/* Save tuple ID, and continue scanning */
 			heapTid = &scan->xs_ctup.t_self;
@@ -367,7 +310,9 @@ btgetbitmap(PG_FUNCTION_ARGS)
 				if (++so->currPos.itemIndex > so->currPos.lastItem)
 				{
 					/* let _bt_next do the heavy lifting */
-					if (!_bt_next(scan, ForwardScanDirection))
+					if (!_bt_next(scan, ForwardScanDirection) &&
+						(!so->skipScan ||
+						 !_bt_skip_first(scan, ForwardScanDirection)))
 						break;
 				}
 
@@ -405,8 +350,9 @@ btbeginscan(PG_FUNCTION_ARGS)
 	so = (BTScanOpaque) palloc(sizeof(BTScanOpaqueData));
 	BTScanPosInvalidate(so->currPos);
 	BTScanPosInvalidate(so->markPos);
+	/* leave room for the extra key a skip scan adds */
 	if (scan->numberOfKeys > 0)
-		so->keyData = (ScanKey) palloc(scan->numberOfKeys * sizeof(ScanKeyData));
+		so->keyData = (ScanKey) palloc((scan->numberOfKeys + 1) * sizeof(ScanKeyData));
 	else
 		so->keyData = NULL;
 
@@ -415,8 +361,17 @@ btbeginscan(PG_FUNCTION_ARGS)
 	so->arrayKeys = NULL;
 	so->arrayContext = NULL;
 
+	so->skipScan = false;		/* until _bt_preprocess_skip_key */
+	so->skipState = so->markSkipState = BT_SKIP_START;
+	so->skipIsNull = so->markSkipIsNull = true;
+	so->skipGeneration = so->markSkipGeneration = 0;
+	so->skipKeyData = NULL;
+	so->skipContext = NULL;
+
 	so->killedItems = NULL;		/* until needed */
 	so->numKilled = 0;
+	so->lastLeaf = InvalidBlockNumber;
+	so->prefetchTarget = 0;
 
 	/*
 	 * We don't know yet whether the scan will be index-only, so we do not
@@ -457,6 +412,7 @@ btrescan(PG_FUNCTION_ARGS)
 	so->markItemIndex = -1;
 	BTScanPosUnpinIfPinned(so->markPos);
 	BTScanPosInvalidate(so->markPos);
+	so->prefetchTarget = 0;
 
 	/*
 	 * Allocate tuple workspace arrays, if needed for an index-only scan and
@@ -493,6 +449,9 @@ btrescan(PG_FUNCTION_ARGS)
 	/* If any keys are SK_SEARCHARRAY type, set up array-key info */
 	_bt_preprocess_array_keys(scan);
 
+	/* See whether we can skip over values of the leading column */
+	_bt_preprocess_skip_key(scan);
+
 	PG_RETURN_VOID();
 }
 
@@ -525,6 +484,9 @@ btendscan(PG_FUNCTION_ARGS)
 	/* so->arrayKeyData and so->arrayKeys are in arrayContext */
 	if (so->arrayContext != NULL)
 		MemoryContextDelete(so->arrayContext);
+	/* so->skipKeyData and skip values are in skipContext */
+	if (so->skipContext != NULL)
+		MemoryContextDelete(so->skipContext);
 	if (so->killedItems != NULL)
 		pfree(so->killedItems);
 	if (so->currTuples != NULL)
@@ -565,6 +527,10 @@ btmarkpos(PG_FUNCTION_ARGS)
 	if (so->numArrayKeys)
 		_bt_mark_array_keys(scan);
 
+	/* ... or the leading column value of a skip scan */
+	if (so->skipScan)
+		_bt_mark_skip_key(scan);
+
 	PG_RETURN_VOID();
 }
 
@@ -581,6 +547,10 @@ btrestrpos(PG_FUNCTION_ARGS)
 	if (so->numArrayKeys)
 		_bt_restore_array_keys(scan);
 
+	/* ... or the leading column value of a skip scan */
+	if (so->skipScan)
+		_bt_restore_skip_key(scan);
+
 	if (so->markItemIndex >= 0)
 	{
 		/*
@@ -643,6 +613,13 @@ btrestrpos(PG_FUNCTION_ARGS)
 			BTScanPosInvalidate(so->currPos);
 	}
 
+	/* Anything prefetched was for the position we left */
+	if (BTScanPosIsValid(so->currPos))
+	{
+		so->currPos.prefetchItem = so->currPos.itemIndex;
+		so->currPos.prefetchPending = 0;
+	}
+
 	PG_RETURN_VOID();
 }
 
@@ -847,7 +824,8 @@ btvacuumscan(IndexVacuumInfo *info, IndexBulkDeleteResult *stats,
 								 RBM_NORMAL, info->strategy);
 		LockBufferForCleanup(buf);
 		_bt_checkpage(rel, buf);
-		_bt_delitems_vacuum(rel, buf, NULL, 0, vstate.lastBlockVacuumed);
+		_bt_delitems_vacuum(rel, buf, NULL, 0, NULL, NULL, 0,
+							vstate.lastBlockVacuumed);
 		_bt_relbuf(rel, buf);
 	}
 
@@ -943,6 +921,10 @@ restart:
 	{
 		OffsetNumber deletable[MaxOffsetNumber];
 		int			ndeletable;
+		OffsetNumber updatable[MaxIndexTuplesPerPage];
+		IndexTuple	updated[MaxIndexTuplesPerPage];
+		int			nupdatable;
+		int			nremoved;
 		OffsetNumber offnum,
 					minoff,
 					maxoff;
@@ -982,6 +964,8 @@ restart:
 		 * callback function.
 		 */
 		ndeletable = 0;
+		nupdatable = 0;
+		nremoved = 0;
 		minoff = P_FIRSTDATAKEY(opaque);
 		maxoff = PageGetMaxOffsetNumber(page);
 		if (callback)
@@ -1018,8 +1002,28 @@ restart:
 				 * applies to *any* type of index that marks index tuples as
 				 * killed.
 				 */
-				if (callback(htup, callback_state))
+				if (BTreeTupleIsPosting(itup))
+				{
+					IndexTuple	newitup;
+					int			nposting = BTreeTupleGetNPosting(itup);
+					int			nremaining;
+
+					newitup = btvacuumposting(itup, callback, callback_state,
+											  &nremaining);
+					if (nremaining == 0)
+						deletable[ndeletable++] = offnum;
+					else if (newitup != NULL)
+					{
+						updatable[nupdatable] = offnum;
+						updated[nupdatable++] = newitup;
+					}
+					nremoved += nposting - nremaining;
+				}
+				else if (callback(htup, callback_state))
+				{
 					deletable[ndeletable++] = offnum;
+					nremoved++;
+				}
 			}
 		}
 
@@ -1027,8 +1031,10 @@ restart:
 		 * Apply any needed deletes.  We issue just one _bt_delitems_vacuum()
 		 * call per page, so as to minimize WAL traffic.
 		 */
-		if (ndeletable > 0)
+		if (ndeletable > 0 || nupdatable > 0)
 		{
+			int			i;
+
 			/*
 			 * Notice that the issued XLOG_BTREE_VACUUM WAL record includes an
 			 * instruction to the replay code to get cleanup lock on all pages
@@ -1041,8 +1047,12 @@ restart:
 			 * that.
 			 */
 			_bt_delitems_vacuum(rel, buf, deletable, ndeletable,
+								updatable, updated, nupdatable,
 								vstate->lastBlockVacuumed);
 
+			for (i = 0; i < nupdatable; i++)
+				pfree(updated[i]);
+
 			/*
 			 * Remember highest leaf page number we've issued a
 			 * XLOG_BTREE_VACUUM WAL record for.
@@ -1050,7 +1060,7 @@ restart:
 			if (blkno > vstate->lastBlockVacuumed)
 				vstate->lastBlockVacuumed = blkno;
 
-			stats->tuples_removed += ndeletable;
+			stats->tuples_removed += nremoved;
 			/* must recompute maxoff */
 			maxoff = PageGetMaxOffsetNumber(page);
 		}
@@ -1082,7 +1092,19 @@ restart:
 		if (minoff > maxoff)
 			delete_now = (blkno == orig_blkno);
 		else
-			stats->num_index_tuples += maxoff - minoff + 1;
+		{
+			/* count heap TIDs, not items, so posting lists count in full */
+			for (offnum = minoff;
+				 offnum <= maxoff;
+				 offnum = OffsetNumberNext(offnum))
+			{
+				IndexTuple	itup;
+
+				itup = (IndexTuple) PageGetItem(page,
+												PageGetItemId(page, offnum));
+				stats->num_index_tuples += BTreeTupleGetNTids(itup);
+			}
+		}
 	}
 
 	if (delete_now)
@@ -1120,6 +1142,40 @@ restart:
 	}
 }
 
+/*
+ * btvacuumposting --- check the heap TIDs of a posting list tuple
+ *
+ * Sets *nremaining to the number of TIDs the callback wants kept.  If some,
+ * but not all, are to go, returns a palloc'd replacement tuple holding just
+ * the survivors; otherwise returns NULL.
+ */
+static IndexTuple
+btvacuumposting(IndexTuple itup, IndexBulkDeleteCallback callback,
+				void *callback_state, int *nremaining)
+{
+	int			nposting = BTreeTupleGetNPosting(itup);
+	ItemPointer live;
+	int			nlive = 0;
+	int			i;
+	IndexTuple	newitup = NULL;
+
+	live = (ItemPointer) palloc(nposting * sizeof(ItemPointerData));
+	for (i = 0; i < nposting; i++)
+	{
+		ItemPointer htid = BTreeTupleGetPostingN(itup, i);
+
+		if (!callback(htid, callback_state))
+			live[nlive++] = *htid;
+	}
+
+	if (nlive > 0 && nlive < nposting)
+		newitup = _bt_form_posting(itup, live, nlive);
+
+	pfree(live);
+	*nremaining = nlive;
+	return newitup;
+}
+
 /*
  *	btcanreturn() -- Check whether btree indexes support index-only scans.
  *
@@ -1130,3 +1186,167 @@ btcanreturn(PG_FUNCTION_ARGS)
 {
 	PG_RETURN_BOOL(true);
 }
+
+/*
+ *	btestimateparallelscan() -- space needed for the shared state of a
+ *		parallel scan with the given number of participants
+ */
+Datum
+btestimateparallelscan(PG_FUNCTION_ARGS)
+{
+	int			nparticipants = PG_GETARG_INT32(0);
+	Size		size;
+
+	size = add_size(offsetof(BTParallelScanDescData, btps_waiters),
+					mul_size(nparticipants, sizeof(int)));
+
+	PG_RETURN_INT64((int64) size);
+}
+
+/*
+ *	btinitparallelscan() -- initialize the shared state of a parallel scan
+ */
+Datum
+btinitparallelscan(PG_FUNCTION_ARGS)
+{
+	BTParallelScanDesc btscan = (BTParallelScanDesc) PG_GETARG_POINTER(0);
+	int			nparticipants = PG_GETARG_INT32(1);
+
+	SpinLockInit(&btscan->btps_mutex);
+	btscan->btps_pageStatus = BTPARALLEL_NOT_INITIALIZED;
+	btscan->btps_scanPage = InvalidBlockNumber;
+	btscan->btps_nwaiters = 0;
+	btscan->btps_maxwaiters = nparticipants;
+
+	PG_RETURN_VOID();
+}
+
+/*
+ *	_bt_parallel_seize() -- get the right to read the next page of a
+ *		parallel scan
+ *
+ * Waits while another participant has the scan seized.  Returns false if
+ * the scan is done.  Otherwise *pageno is set to the page to read next, or
+ * to InvalidBlockNumber if the scan hasn't started yet, in which case the
+ * caller must descend the tree to find the first page; and the caller
+ * must then call _bt_parallel_release() or _bt_parallel_done().
+ */
+bool
+_bt_parallel_seize(IndexScanDesc scan, BlockNumber *pageno)
+{
+	BTParallelScanDesc btscan = BTParallelScanGetState(scan->parallel_scan);
+
+	for (;;)
+	{
+		BTPS_State	status;
+		int			i;
+
+		SpinLockAcquire(&btscan->btps_mutex);
+		status = btscan->btps_pageStatus;
+		if (status == BTPARALLEL_NOT_INITIALIZED ||
+			status == BTPARALLEL_IDLE)
+		{
+			*pageno = (status == BTPARALLEL_IDLE) ?
+				btscan->btps_scanPage : InvalidBlockNumber;
+			btscan->btps_pageStatus = BTPARALLEL_ADVANCING;
+		}
+		else if (status == BTPARALLEL_ADVANCING)
+		{
+			/* Make sure we get woken up, unless we're on the list already */
+			for (i = 0; i < btscan->btps_nwaiters; i++)
+			{
+				if (btscan->btps_waiters[i] == MyProc->pgprocno)
+					break;
+			}
+			if (i == btscan->btps_nwaiters)
+			{
+				Assert(btscan->btps_nwaiters < btscan->btps_maxwaiters);
+				btscan->btps_waiters[btscan->btps_nwaiters++] =
+					MyProc->pgprocno;
+			}
+		}
+		SpinLockRelease(&btscan->btps_mutex);
+
+		if (status == BTPARALLEL_DONE)
+			return false;
+		if (status != BTPARALLEL_ADVANCING)
+			return true;
+
+		pgstat_report_wait_start(WAIT_EVENT_BTREE_PAGE);
+		WaitLatch(MyLatch, WL_LATCH_SET, 0);
+		pgstat_report_wait_end();
+		ResetLatch(MyLatch);
+		CHECK_FOR_INTERRUPTS();
+	}
+}
+
+/*
+ *	_bt_parallel_release() -- let the next participant of a parallel scan
+ *		go on with scan_page
+ *
+ * Called after reading the right-link of the page we seized the scan for.
+ * If there's no page to the right, the scan is done.
+ */
+void
+_bt_parallel_release(IndexScanDesc scan, BlockNumber scan_page)
+{
+	BTParallelScanDesc btscan = BTParallelScanGetState(scan->parallel_scan);
+
+	if (scan_page == P_NONE)
+		_bt_parallel_set_status(btscan, BTPARALLEL_DONE, InvalidBlockNumber);
+	else
+		_bt_parallel_set_status(btscan, BTPARALLEL_IDLE, scan_page);
+}
+
+/*
+ *	_bt_parallel_done() -- mark a parallel scan as done
+ *
+ * Called when we find that no later page can have matches.  Whoever has
+ * the scan seized at the time doesn't need to know: once done, the scan
+ * stays done.
+ */
+void
+_bt_parallel_done(IndexScanDesc scan)
+{
+	BTParallelScanDesc btscan = BTParallelScanGetState(scan->parallel_scan);
+
+	_bt_parallel_set_status(btscan, BTPARALLEL_DONE, InvalidBlockNumber);
+}
+
+/*
+ * Set the status of a parallel scan, unless it's done already, and wake up
+ * the participants waiting for that.
+ */
+static void
+_bt_parallel_set_status(BTParallelScanDesc btscan, BTPS_State status,
+						BlockNumber scan_page)
+{
+	static int *waiters = NULL;
+	static int	maxwaiters = 0;
+	int			nwaiters = 0;
+	int			i;
+
+	/* Can't SetLatch while holding the spinlock, so copy the list first */
+	if (maxwaiters < btscan->btps_maxwaiters)
+	{
+		if (waiters != NULL)
+			pfree(waiters);
+		waiters = MemoryContextAlloc(TopMemoryContext,
+									 btscan->btps_maxwaiters * sizeof(int));
+		maxwaiters = btscan->btps_maxwaiters;
+	}
+
+	SpinLockAcquire(&btscan->btps_mutex);
+	if (btscan->btps_pageStatus != BTPARALLEL_DONE)
+	{
+		btscan->btps_pageStatus = status;
+		btscan->btps_scanPage = scan_page;
+		nwaiters = btscan->btps_nwaiters;
+		memcpy(waiters, btscan->btps_waiters, nwaiters * sizeof(int));
+		btscan->btps_nwaiters = 0;
+	}
+	SpinLockRelease(&btscan->btps_mutex);
+
+	for (i = 0; i < nwaiters; i++)
+		SetLatch(&ProcGlobal->allProcs[waiters[i]].procLatch);
+}
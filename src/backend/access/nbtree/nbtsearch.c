@@ -17,6 +17,7 @@
 
 #include "access/nbtree.h"
 #include "access/relscan.h"
+#include "access/xlog.h"
 #include "miscadmin.h"
 #include "pgstat.h"
 #include "storage/predicate.h"
@@ -25,13 +26,24 @@
 #include "utils/tqual.h"
 
 
+static Buffer _bt_search_unlocked(Relation rel, int keysz, ScanKey scankey,
+					bool nextkey, BTStack *stack);
+static Buffer _bt_search_leaf_hint(Relation rel, BlockNumber blkno, int keysz,
+					 ScanKey scankey, bool nextkey);
+static OffsetNumber _bt_binsrch_page(Relation rel, Page page, int keysz,
+				 ScanKey scankey, bool nextkey);
 static bool _bt_readpage(IndexScanDesc scan, ScanDirection dir,
 			 OffsetNumber offnum);
 static void _bt_saveitem(BTScanOpaque so, int itemIndex,
 			 OffsetNumber offnum, IndexTuple itup);
+static void _bt_savepostingitems(BTScanOpaque so, int itemIndex,
+					 OffsetNumber offnum, IndexTuple itup);
 static bool _bt_steppage(IndexScanDesc scan, ScanDirection dir);
 static Buffer _bt_walk_left(Relation rel, Buffer buf);
 static bool _bt_endpoint(IndexScanDesc scan, ScanDirection dir);
+static bool _bt_parallel_readpage(IndexScanDesc scan, BlockNumber blkno,
+					  ScanDirection dir);
+static bool _bt_skip_advance(IndexScanDesc scan, ScanDirection dir);
 static void _bt_drop_lock_and_maybe_pin(IndexScanDesc scan, BTScanPos sp);
 
 
@@ -84,6 +96,10 @@ _bt_drop_lock_and_maybe_pin(IndexScanDesc scan, BTScanPos sp)
  * to be created and returned.  When access = BT_READ, an empty index
  * will result in *bufP being set to InvalidBuffer.  Also, in BT_WRITE mode,
  * any incomplete splits encountered during the search will be finished.
+ *
+ * In BT_READ mode, we try to get through the internal levels of the tree
+ * without locking them at all; see _bt_search_unlocked().  We carry on
+ * from wherever that leaves off, with a locked buffer.
  */
 BTStack
 _bt_search(Relation rel, int keysz, ScanKey scankey, bool nextkey,
@@ -91,8 +107,13 @@ _bt_search(Relation rel, int keysz, ScanKey scankey, bool nextkey,
 {
 	BTStack		stack_in = NULL;
 
-	/* Get the root page to start with */
-	*bufP = _bt_getroot(rel, access);
+	*bufP = InvalidBuffer;
+	if (access == BT_READ && !RecoveryInProgress())
+		*bufP = _bt_search_unlocked(rel, keysz, scankey, nextkey, &stack_in);
+
+	/* Otherwise, get the root page to start with */
+	if (!BufferIsValid(*bufP))
+		*bufP = _bt_getroot(rel, access);
 
 	/* If index is empty and access = BT_READ, no root page is created. */
 	if (!BufferIsValid(*bufP))
@@ -168,6 +189,160 @@ _bt_search(Relation rel, int keysz, ScanKey scankey, bool nextkey,
 	return stack_in;
 }
 
+/*
+ *	_bt_search_unlocked() -- descend the internal levels without locks.
+ *
+ * The root and level-one pages of a busy index are locked by every search,
+ * and the lock traffic on their buffers becomes a bottleneck well before the
+ * pages themselves are.  Here we instead pin each internal page, take a
+ * private copy of it with _bt_page_copy_unlocked(), and make the same
+ * decisions _bt_moveright() and _bt_binsrch() would make, against the copy.
+ * That is safe because a search never writes anything to the pages it passes
+ * through, and the copy's change counter proves that no writer was busy
+ * with the page while we copied it.  A copy may be out of date by the time
+ * we look at it, but then it's the same as if we had locked the page a
+ * moment earlier: the usual Lehman and Yao move-right rule takes care of any
+ * split that happens after we leave a page.
+ *
+ * We stop with the buffer read-locked once we reach a leaf page, or when a
+ * page can't be copied consistently (it is busy, or it looks odd), leaving
+ * it to the caller's locking loop to finish the search from there.  The
+ * stack built so far is returned in *stack.  Returns InvalidBuffer if we
+ * didn't get started at all: there is no cached metapage to find the root
+ * from, the root is a leaf, or the cached root turns out to be stale.
+ *
+ * Hot standby replays page changes without the change counter protocol, so
+ * this is not used during recovery.
+ */
+static Buffer
+_bt_search_unlocked(Relation rel, int keysz, ScanKey scankey, bool nextkey,
+					BTStack *stack)
+{
+	BTMetaPageData *metad;
+	union
+	{
+		char		data[BLCKSZ];
+		double		force_align_d;
+	}			copybuf;
+	Page		copy = (Page) copybuf.data;
+	Buffer		buf;
+	uint32		rootlevel;
+	bool		atroot = true;
+	int32		cmpval = nextkey ? 0 : 1;
+
+	/* _bt_getroot() has cached the metapage for us, if it has been called */
+	if (rel->rd_amcache == NULL)
+		return InvalidBuffer;
+	metad = (BTMetaPageData *) rel->rd_amcache;
+	if (metad->btm_fastlevel == 0)
+		return InvalidBuffer;
+
+	rootlevel = metad->btm_fastlevel;
+	buf = ReadBuffer(rel, metad->btm_fastroot);
+
+	for (;;)
+	{
+		BTPageOpaque opaque;
+		OffsetNumber offnum;
+		IndexTuple	itup;
+		BTStack		new_stack;
+
+		if (!_bt_page_copy_unlocked(buf, copy))
+			break;
+		opaque = (BTPageOpaque) PageGetSpecialPointer(copy);
+
+		/* Check the cached root the same way _bt_getroot() does */
+		if (atroot)
+		{
+			if (P_IGNORE(opaque) ||
+				opaque->btpo.level != rootlevel ||
+				!P_LEFTMOST(opaque) ||
+				!P_RIGHTMOST(opaque))
+			{
+				ReleaseBuffer(buf);
+				return InvalidBuffer;
+			}
+			atroot = false;
+		}
+
+		if (P_ISLEAF(opaque))
+			break;
+
+		/* Move right if the page has split, as in _bt_moveright() */
+		if (P_IGNORE(opaque) ||
+			(!P_RIGHTMOST(opaque) &&
+			 _bt_compare(rel, keysz, scankey, copy, P_HIKEY) >= cmpval))
+		{
+			if (P_RIGHTMOST(opaque))
+				break;			/* let _bt_moveright() complain */
+			buf = ReleaseAndReadBuffer(buf, rel, opaque->btpo_next);
+			continue;
+		}
+
+		/* Descend to the child, remembering the way as in _bt_search() */
+		offnum = _bt_binsrch_page(rel, copy, keysz, scankey, nextkey);
+		itup = (IndexTuple) PageGetItem(copy, PageGetItemId(copy, offnum));
+
+		new_stack = (BTStack) palloc(sizeof(BTStackData));
+		new_stack->bts_blkno = BufferGetBlockNumber(buf);
+		new_stack->bts_offset = offnum;
+		memcpy(&new_stack->bts_btentry, itup, sizeof(IndexTupleData));
+		new_stack->bts_parent = *stack;
+		*stack = new_stack;
+
+		buf = ReleaseAndReadBuffer(buf, rel,
+								   ItemPointerGetBlockNumber(&(itup->t_tid)));
+	}
+
+	LockBuffer(buf, BT_READ);
+	_bt_checkpage(rel, buf);
+
+	return buf;
+}
+
+/*
+ *	_bt_search_leaf_hint() -- try to find the leaf page for a scankey
+ *		without descending the tree.
+ *
+ * An inner index scan of a nested loop is rescanned once per outer row, and
+ * when the outer rows arrive in (or near) index order, consecutive keys
+ * usually land on the same leaf page.  Here we check whether leaf page
+ * blkno, typically the one the previous search of this scan ended on, is
+ * still the right place to start the search for scankey: it must be a live
+ * leaf page whose key range covers scankey.  The high key bounds the range
+ * from above, as in _bt_moveright().  There is no lower bound stored on the
+ * page, so we require the first item on it to be strictly before the
+ * position we are looking for; then no earlier page can hold anything we
+ * want.
+ *
+ * Returns the read-locked buffer if so, else InvalidBuffer, and the caller
+ * must do a regular _bt_search().
+ */
+static Buffer
+_bt_search_leaf_hint(Relation rel, BlockNumber blkno, int keysz,
+					 ScanKey scankey, bool nextkey)
+{
+	Buffer		buf;
+	Page		page;
+	BTPageOpaque opaque;
+	int32		cmpval = nextkey ? 0 : 1;
+
+	buf = _bt_getbuf(rel, blkno, BT_READ);
+	page = BufferGetPage(buf);
+	opaque = (BTPageOpaque) PageGetSpecialPointer(page);
+
+	if (P_ISLEAF(opaque) && !P_IGNORE(opaque) &&
+		P_FIRSTDATAKEY(opaque) <= PageGetMaxOffsetNumber(page) &&
+		(P_RIGHTMOST(opaque) ||
+		 _bt_compare(rel, keysz, scankey, page, P_HIKEY) < cmpval) &&
+		_bt_compare(rel, keysz, scankey, page,
+					P_FIRSTDATAKEY(opaque)) >= cmpval)
+		return buf;
+
+	_bt_relbuf(rel, buf);
+	return InvalidBuffer;
+}
+
 /*
  *	_bt_moveright() -- move right in the btree if necessary.
  *
@@ -312,14 +487,26 @@ _bt_binsrch(Relation rel,
 			ScanKey scankey,
 			bool nextkey)
 {
-	Page		page;
+	return _bt_binsrch_page(rel, BufferGetPage(buf), keysz, scankey, nextkey);
+}
+
+/*
+ * Workhorse for _bt_binsrch, also used on the page copies made by
+ * _bt_search_unlocked.
+ */
+static OffsetNumber
+_bt_binsrch_page(Relation rel,
+				 Page page,
+				 int keysz,
+				 ScanKey scankey,
+				 bool nextkey)
+{
 	BTPageOpaque opaque;
 	OffsetNumber low,
 				high;
 	int32		result,
 				cmpval;
 
-	page = BufferGetPage(buf);
 	opaque = (BTPageOpaque) PageGetSpecialPointer(page);
 
 	low = P_FIRSTDATAKEY(opaque);
@@ -420,6 +607,7 @@ _bt_compare(Relation rel,
 	TupleDesc	itupdesc = RelationGetDescr(rel);
 	BTPageOpaque opaque = (BTPageOpaque) PageGetSpecialPointer(page);
 	IndexTuple	itup;
+	int			ntupatts;
 	int			i;
 
 	/*
@@ -431,6 +619,17 @@ _bt_compare(Relation rel,
 
 	itup = (IndexTuple) PageGetItem(page, PageGetItemId(page, offnum));
 
+	/*
+	 * High keys and internal items may have been truncated to fewer key
+	 * attributes than the index has.  The missing attributes are treated as
+	 * minus infinity, so a scan key that matches all the attributes present
+	 * is ">" the tuple.
+	 */
+	if (!P_ISLEAF(opaque) || offnum < P_FIRSTDATAKEY(opaque))
+		ntupatts = BTreeTupleGetNAtts(itup, rel);
+	else
+		ntupatts = RelationGetNumberOfAttributes(rel);
+
 	/*
 	 * The scan key is set up with the attribute number associated with each
 	 * term in the key.  It is important that, if the index is multi-key, the
@@ -449,6 +648,9 @@ _bt_compare(Relation rel,
 		bool		isNull;
 		int32		result;
 
+		if (scankey->sk_attno > ntupatts)
+			return 1;
+
 		datum = index_getattr(itup, scankey->sk_attno, itupdesc, &isNull);
 
 		/* see comments about NULLs handling in btbuild */
@@ -554,6 +756,24 @@ _bt_first(IndexScanDesc scan, ScanDirection dir)
 	if (!so->qual_ok)
 		return false;
 
+	/*
+	 * In a parallel scan, only the first participant to get here descends
+	 * the tree; the others start from whatever page is next to be read.
+	 */
+	if (scan->parallel_scan != NULL)
+	{
+		BlockNumber blkno;
+
+		if (!_bt_parallel_seize(scan, &blkno))
+			return false;
+		if (blkno != InvalidBlockNumber)
+		{
+			if (!_bt_parallel_readpage(scan, blkno, dir))
+				return false;
+			goto readcomplete;
+		}
+	}
+
 	/*----------
 	 * Examine the scan keys to discover where we need to start the scan.
 	 *
@@ -763,7 +983,11 @@ _bt_first(IndexScanDesc scan, ScanDirection dir)
 
 			Assert(subkey->sk_flags & SK_ROW_MEMBER);
 			if (subkey->sk_flags & SK_ISNULL)
+			{
+				if (scan->parallel_scan != NULL)
+					_bt_parallel_done(scan);
 				return false;
+			}
 			memcpy(scankeys + i, subkey, sizeof(ScanKeyData));
 
 			/*
@@ -968,12 +1192,22 @@ _bt_first(IndexScanDesc scan, ScanDirection dir)
 
 	/*
 	 * Use the manufactured insertion scan key to descend the tree and
-	 * position ourselves on the target leaf page.
+	 * position ourselves on the target leaf page.  If this scan has been
+	 * here before, first see whether the leaf page the last search ended on
+	 * will do, which saves the descent when a rescanned scan's keys follow
+	 * the index order.
 	 */
-	stack = _bt_search(rel, keysCount, scankeys, nextkey, &buf, BT_READ);
+	buf = InvalidBuffer;
+	if (BlockNumberIsValid(so->lastLeaf))
+		buf = _bt_search_leaf_hint(rel, so->lastLeaf, keysCount, scankeys,
+								   nextkey);
+	if (!BufferIsValid(buf))
+	{
+		stack = _bt_search(rel, keysCount, scankeys, nextkey, &buf, BT_READ);
 
-	/* don't need to keep the stack around... */
-	_bt_freestack(stack);
+		/* don't need to keep the stack around... */
+		_bt_freestack(stack);
+	}
 
 	if (!BufferIsValid(buf))
 	{
@@ -982,12 +1216,16 @@ _bt_first(IndexScanDesc scan, ScanDirection dir)
 		 * because nothing finer to lock exists.
 		 */
 		PredicateLockRelation(rel, scan->xs_snapshot);
+		if (scan->parallel_scan != NULL)
+			_bt_parallel_done(scan);
 		return false;
 	}
 	else
 		PredicateLockPage(rel, BufferGetBlockNumber(buf),
 						  scan->xs_snapshot);
 
+	so->lastLeaf = BufferGetBlockNumber(buf);
+
 	/* initialize moreLeft/moreRight appropriately for scan direction */
 	if (ScanDirectionIsForward(dir))
 	{
@@ -1076,6 +1314,7 @@ _bt_first(IndexScanDesc scan, ScanDirection dir)
 		_bt_drop_lock_and_maybe_pin(scan, &so->currPos);
 	}
 
+readcomplete:
 	/* OK, itemIndex says what to return */
 	currItem = &so->currPos.items[so->currPos.itemIndex];
 	scan->xs_ctup.t_self = currItem->heapTid;
@@ -1135,6 +1374,189 @@ _bt_next(IndexScanDesc scan, ScanDirection dir)
 	return true;
 }
 
+/*
+ *	_bt_skip_first() -- Find the first match for the next leading value.
+ *
+ * In a skip scan (see _bt_preprocess_skip_key), this is used in place of
+ * _bt_first() both to start the scan and whenever the matches for the
+ * current leading column value run out.  We move on to the next value in
+ * the given direction and do a _bt_first() for it, until some value has a
+ * match or we run out of values.  Exit conditions are as for _bt_first().
+ */
+bool
+_bt_skip_first(IndexScanDesc scan, ScanDirection dir)
+{
+	Assert(((BTScanOpaque) scan->opaque)->skipScan);
+
+	while (_bt_skip_advance(scan, dir))
+	{
+		if (_bt_first(scan, dir))
+			return true;
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	return false;
+}
+
+/*
+ * Give up on skipping after this many consecutive probes land on the
+ * leaf page the scan was already on.  That means there are several values
+ * per page, and reading straight through is cheaper than descending the
+ * tree for each one.
+ */
+#define BT_SKIP_MAX_WASTED	4
+
+/*
+ *	_bt_skip_advance() -- Step the skip scan to the next leading value.
+ *
+ * We descend the tree to find the first index entry whose leading column
+ * is beyond skipValue in the given direction, or the first entry of all if
+ * we're just starting, and install its leading column as the new value.
+ * Returns false if there are no more values.
+ */
+static bool
+_bt_skip_advance(IndexScanDesc scan, ScanDirection dir)
+{
+	Relation	rel = scan->indexRelation;
+	BTScanOpaque so = (BTScanOpaque) scan->opaque;
+	bool		forward = ScanDirectionIsForward(dir);
+	Buffer		buf;
+	Page		page;
+	BTPageOpaque opaque;
+	OffsetNumber offnum;
+	BlockNumber blkno;
+	IndexTuple	itup;
+	Datum		value;
+	bool		isnull;
+
+	if (so->skipState == BT_SKIP_BOUND && dir == so->skipDir)
+	{
+		bool		nullsfirst;
+
+		/*
+		 * The bound scan has read everything to the end of the index, except
+		 * for any NULLs there, since the bound key doesn't match those.
+		 */
+		nullsfirst = (rel->rd_indoption[0] & INDOPTION_NULLS_FIRST) != 0;
+		if (forward != nullsfirst)
+		{
+			so->skipState = BT_SKIP_EQUAL;
+			_bt_set_skip_value(scan, (Datum) 0, true);
+			return true;
+		}
+		so->skipState = BT_SKIP_START;
+		return false;
+	}
+
+	if (so->skipState == BT_SKIP_START)
+	{
+		buf = _bt_get_endpoint(rel, 0, !forward);
+		if (!BufferIsValid(buf))
+			return false;
+		page = BufferGetPage(buf);
+		opaque = (BTPageOpaque) PageGetSpecialPointer(page);
+		offnum = forward ? P_FIRSTDATAKEY(opaque) :
+			PageGetMaxOffsetNumber(page);
+	}
+	else
+	{
+		ScanKeyData skey;
+		BTStack		stack;
+		int			flags;
+
+		/*
+		 * Build an insertion scan key for the current value, as
+		 * _bt_mkscankey would, and look for the first entry greater than it
+		 * (going forward) or the last entry less than it (going backward).
+		 */
+		flags = (so->skipIsNull ? SK_ISNULL : 0) |
+			(rel->rd_indoption[0] << SK_BT_INDOPTION_SHIFT);
+		ScanKeyEntryInitializeWithInfo(&skey,
+									   flags,
+									   1,
+									   InvalidStrategy,
+									   InvalidOid,
+									   rel->rd_indcollation[0],
+									   index_getprocinfo(rel, 1, BTORDER_PROC),
+									   so->skipValue);
+
+		stack = _bt_search(rel, 1, &skey, forward, &buf, BT_READ);
+		_bt_freestack(stack);
+		if (!BufferIsValid(buf))
+		{
+			so->skipState = BT_SKIP_START;
+			return false;
+		}
+		offnum = _bt_binsrch(rel, buf, 1, &skey, forward);
+		if (!forward)
+			offnum = OffsetNumberPrev(offnum);
+	}
+
+	/* Step over pages that have nothing for us, as _bt_steppage would */
+	for (;;)
+	{
+		page = BufferGetPage(buf);
+		opaque = (BTPageOpaque) PageGetSpecialPointer(page);
+		if (!P_IGNORE(opaque) &&
+			offnum >= P_FIRSTDATAKEY(opaque) &&
+			offnum <= PageGetMaxOffsetNumber(page))
+			break;
+
+		if (forward)
+		{
+			if (P_RIGHTMOST(opaque))
+			{
+				_bt_relbuf(rel, buf);
+				so->skipState = BT_SKIP_START;
+				return false;
+			}
+			buf = _bt_relandgetbuf(rel, buf, opaque->btpo_next, BT_READ);
+			page = BufferGetPage(buf);
+			opaque = (BTPageOpaque) PageGetSpecialPointer(page);
+			offnum = P_FIRSTDATAKEY(opaque);
+		}
+		else
+		{
+			buf = _bt_walk_left(rel, buf);
+			if (!BufferIsValid(buf))
+			{
+				so->skipState = BT_SKIP_START;
+				return false;
+			}
+			offnum = PageGetMaxOffsetNumber(BufferGetPage(buf));
+		}
+	}
+
+	/*
+	 * Lock the page for serializable transactions: a new value inserted
+	 * between the previous one and this would have to go on it.
+	 */
+	blkno = BufferGetBlockNumber(buf);
+	PredicateLockPage(rel, blkno, scan->xs_snapshot);
+
+	itup = (IndexTuple) PageGetItem(page, PageGetItemId(page, offnum));
+	value = index_getattr(itup, 1, RelationGetDescr(rel), &isnull);
+
+	/* Decide whether it's worth going on skipping */
+	if (so->skipState != BT_SKIP_START && blkno == so->skipLastBlock)
+		so->skipNumWasted++;
+	else
+		so->skipNumWasted = 0;
+
+	if (so->skipNumWasted >= BT_SKIP_MAX_WASTED && !isnull)
+	{
+		so->skipState = BT_SKIP_BOUND;
+		so->skipDir = dir;
+	}
+	else
+		so->skipState = BT_SKIP_EQUAL;
+	_bt_set_skip_value(scan, value, isnull);
+
+	_bt_relbuf(rel, buf);
+
+	return true;
+}
+
 /*
  *	_bt_readpage() -- Load data from current index page into so->currPos
  *
@@ -1178,6 +1600,8 @@ _bt_readpage(IndexScanDesc scan, ScanDirection dir, OffsetNumber offnum)
 	 * This allows us to re-read the buffer if it is needed again for hinting.
 	 */
 	so->currPos.currPage = BufferGetBlockNumber(so->currPos.buf);
+	if (so->skipScan)
+		so->skipLastBlock = so->currPos.currPage;
 
 	/*
 	 * We save the LSN of the page as we read it, so that we know whether it
@@ -1193,6 +1617,13 @@ _bt_readpage(IndexScanDesc scan, ScanDirection dir, OffsetNumber offnum)
 	 */
 	so->currPos.nextPage = opaque->btpo_next;
 
+	/*
+	 * In a parallel scan, that's all the next participant needs to go on
+	 * with, so let it.
+	 */
+	if (scan->parallel_scan != NULL && ScanDirectionIsForward(dir))
+		_bt_parallel_release(scan, opaque->btpo_next);
+
 	/* initialize tuple workspace to empty */
 	so->currPos.nextTupleOffset = 0;
 
@@ -1215,20 +1646,30 @@ _bt_readpage(IndexScanDesc scan, ScanDirection dir, OffsetNumber offnum)
 			if (itup != NULL)
 			{
 				/* tuple passes all scan key conditions, so remember it */
-				_bt_saveitem(so, itemIndex, offnum, itup);
-				itemIndex++;
+				if (BTreeTupleIsPosting(itup))
+				{
+					_bt_savepostingitems(so, itemIndex, offnum, itup);
+					itemIndex += BTreeTupleGetNPosting(itup);
+				}
+				else
+				{
+					_bt_saveitem(so, itemIndex, offnum, itup);
+					itemIndex++;
+				}
 			}
 			if (!continuescan)
 			{
 				/* there can't be any more matches, so stop */
 				so->currPos.moreRight = false;
+				if (scan->parallel_scan != NULL)
+					_bt_parallel_done(scan);
 				break;
 			}
 
 			offnum = OffsetNumberNext(offnum);
 		}
 
-		Assert(itemIndex <= MaxIndexTuplesPerPage);
+		Assert(itemIndex <= MaxTIDsPerBTreePage);
 		so->currPos.firstItem = 0;
 		so->currPos.lastItem = itemIndex - 1;
 		so->currPos.itemIndex = 0;
@@ -1236,7 +1677,7 @@ _bt_readpage(IndexScanDesc scan, ScanDirection dir, OffsetNumber offnum)
 	else
 	{
 		/* load items[] in descending order */
-		itemIndex = MaxIndexTuplesPerPage;
+		itemIndex = MaxTIDsPerBTreePage;
 
 		offnum = Min(offnum, maxoff);
 
@@ -1246,8 +1687,16 @@ _bt_readpage(IndexScanDesc scan, ScanDirection dir, OffsetNumber offnum)
 			if (itup != NULL)
 			{
 				/* tuple passes all scan key conditions, so remember it */
-				itemIndex--;
-				_bt_saveitem(so, itemIndex, offnum, itup);
+				if (BTreeTupleIsPosting(itup))
+				{
+					itemIndex -= BTreeTupleGetNPosting(itup);
+					_bt_savepostingitems(so, itemIndex, offnum, itup);
+				}
+				else
+				{
+					itemIndex--;
+					_bt_saveitem(so, itemIndex, offnum, itup);
+				}
 			}
 			if (!continuescan)
 			{
@@ -1261,13 +1710,85 @@ _bt_readpage(IndexScanDesc scan, ScanDirection dir, OffsetNumber offnum)
 
 		Assert(itemIndex >= 0);
 		so->currPos.firstItem = itemIndex;
-		so->currPos.lastItem = MaxIndexTuplesPerPage - 1;
-		so->currPos.itemIndex = MaxIndexTuplesPerPage - 1;
+		so->currPos.lastItem = MaxTIDsPerBTreePage - 1;
+		so->currPos.itemIndex = MaxTIDsPerBTreePage - 1;
 	}
 
+	/* nothing on the new page has been prefetched yet */
+	so->currPos.prefetchItem = so->currPos.itemIndex;
+	so->currPos.prefetchPending = 0;
+
 	return (so->currPos.firstItem <= so->currPos.lastItem);
 }
 
+/*
+ *	_bt_prefetch_heap() -- read ahead heap pages for upcoming items
+ *
+ * Called by btgettuple each time it returns an item.  The items array of the
+ * current leaf page tells us which heap pages the scan will visit next, so
+ * we keep the buffer manager told about the next so->prefetchTarget of them.
+ * Only changes of heap block between adjacent items count, which takes care
+ * of the common case of a correlated index.  currPos.prefetchItem is the
+ * last item examined for prefetching, and currPos.prefetchPending the number
+ * of prefetched blocks the scan has not reached yet.
+ *
+ * As in a bitmap heap scan, the prefetch distance starts at zero and ramps
+ * up to target_prefetch_pages as the scan moves on to new heap pages, so a
+ * scan that only visits one or two heap pages, like most inner scans of a
+ * nested loop, doesn't issue prefetches at all.
+ *
+ * There's nothing to gain for bitmap scans, which have no heap relation
+ * here and do their own prefetching, nor for index-only scans, which
+ * usually don't visit the heap at all.
+ */
+void
+_bt_prefetch_heap(IndexScanDesc scan, ScanDirection dir)
+{
+#ifdef USE_PREFETCH
+	BTScanOpaque so = (BTScanOpaque) scan->opaque;
+	BTScanPos	pos = &so->currPos;
+	BTScanPosItem *items = pos->items;
+	bool		forward = ScanDirectionIsForward(dir);
+	int			step = forward ? 1 : -1;
+	int			i = pos->itemIndex;
+	BlockNumber blkno;
+
+	if (target_prefetch_pages <= 0 ||
+		scan->heapRelation == NULL || scan->xs_want_itup)
+		return;
+
+	/* Start over if the scan has turned around */
+	if (forward ? pos->prefetchItem < i : pos->prefetchItem > i)
+	{
+		pos->prefetchItem = i;
+		pos->prefetchPending = 0;
+	}
+	else if (i != (forward ? pos->firstItem : pos->lastItem) &&
+			 ItemPointerGetBlockNumber(&items[i].heapTid) !=
+			 ItemPointerGetBlockNumber(&items[i - step].heapTid))
+	{
+		/* We've moved on to a new heap page, which may have been prefetched */
+		if (pos->prefetchPending > 0)
+			pos->prefetchPending--;
+		if (so->prefetchTarget < target_prefetch_pages)
+			so->prefetchTarget = Min(Max(so->prefetchTarget * 2, 1),
+									 target_prefetch_pages);
+	}
+
+	while (pos->prefetchPending < so->prefetchTarget &&
+		   pos->prefetchItem != (forward ? pos->lastItem : pos->firstItem))
+	{
+		pos->prefetchItem += step;
+		blkno = ItemPointerGetBlockNumber(&items[pos->prefetchItem].heapTid);
+		if (blkno != ItemPointerGetBlockNumber(&items[pos->prefetchItem - step].heapTid))
+		{
+			PrefetchBuffer(scan->heapRelation, MAIN_FORKNUM, blkno);
+			pos->prefetchPending++;
+		}
+	}
+#endif   /* USE_PREFETCH */
+}
+
 /* Save an index item into so->currPos.items[itemIndex] */
 static void
 _bt_saveitem(BTScanOpaque so, int itemIndex,
@@ -1287,6 +1808,45 @@ _bt_saveitem(BTScanOpaque so, int itemIndex,
 	}
 }
 
+/*
+ * Save the heap TIDs of a posting list tuple into so->currPos.items[],
+ * starting at itemIndex.
+ *
+ * The TIDs are saved in descending order.  A newly inserted duplicate goes
+ * in front of the equal keys already on the page, so without posting lists
+ * a forward scan returns duplicates roughly newest first; returning the
+ * TIDs of a posting list the same way keeps deduplicating a page from
+ * changing the order in which its duplicates are returned.
+ *
+ * For an index-only scan, they all share a single copy of the tuple.
+ */
+static void
+_bt_savepostingitems(BTScanOpaque so, int itemIndex,
+					 OffsetNumber offnum, IndexTuple itup)
+{
+	int			nposting = BTreeTupleGetNPosting(itup);
+	LocationIndex tupleOffset = 0;
+	int			i;
+
+	if (so->currTuples)
+	{
+		Size		itupsz = IndexTupleSize(itup);
+
+		tupleOffset = so->currPos.nextTupleOffset;
+		memcpy(so->currTuples + so->currPos.nextTupleOffset, itup, itupsz);
+		so->currPos.nextTupleOffset += MAXALIGN(itupsz);
+	}
+
+	for (i = 0; i < nposting; i++)
+	{
+		BTScanPosItem *currItem = &so->currPos.items[itemIndex + i];
+
+		currItem->heapTid = *BTreeTupleGetPostingN(itup, nposting - 1 - i);
+		currItem->indexOffset = offnum;
+		currItem->tupleOffset = tupleOffset;
+	}
+}
+
 /*
  *	_bt_steppage() -- Step to next page containing valid data for scan
  *
@@ -1352,7 +1912,22 @@ _bt_steppage(IndexScanDesc scan, ScanDirection dir)
 		for (;;)
 		{
 			/* if we're at end of scan, give up */
-			if (blkno == P_NONE || !so->currPos.moreRight)
+			if (!so->currPos.moreRight)
+			{
+				BTScanPosInvalidate(so->currPos);
+				return false;
+			}
+
+			/* in a parallel scan, the shared state knows the next page */
+			if (scan->parallel_scan != NULL &&
+				!_bt_parallel_seize(scan, &blkno))
+			{
+				BTScanPosInvalidate(so->currPos);
+				return false;
+			}
+			Assert(BlockNumberIsValid(blkno));
+
+			if (blkno == P_NONE)
 			{
 				BTScanPosInvalidate(so->currPos);
 				return false;
@@ -1372,6 +1947,8 @@ _bt_steppage(IndexScanDesc scan, ScanDirection dir)
 				if (_bt_readpage(scan, dir, P_FIRSTDATAKEY(opaque)))
 					break;
 			}
+			else if (scan->parallel_scan != NULL)
+				_bt_parallel_release(scan, opaque->btpo_next);
 
 			/* nope, keep going */
 			blkno = opaque->btpo_next;
@@ -1688,6 +2265,8 @@ _bt_endpoint(IndexScanDesc scan, ScanDirection dir)
 		 */
 		PredicateLockRelation(rel, scan->xs_snapshot);
 		BTScanPosInvalidate(so->currPos);
+		if (scan->parallel_scan != NULL)
+			_bt_parallel_done(scan);
 		return false;
 	}
 
@@ -1759,3 +2338,53 @@ _bt_endpoint(IndexScanDesc scan, ScanDirection dir)
 
 	return true;
 }
+
+/*
+ *	_bt_parallel_readpage() -- Start a participant of a parallel scan on
+ *		the page it seized the scan for.
+ *
+ * Used by _bt_first() in place of the descent of the tree, once another
+ * participant has done that.  Exit conditions are as for _bt_first().
+ */
+static bool
+_bt_parallel_readpage(IndexScanDesc scan, BlockNumber blkno,
+					  ScanDirection dir)
+{
+	Relation	rel = scan->indexRelation;
+	BTScanOpaque so = (BTScanOpaque) scan->opaque;
+	Page		page;
+	BTPageOpaque opaque;
+
+	Assert(ScanDirectionIsForward(dir));
+
+	so->currPos.moreLeft = false;
+	so->currPos.moreRight = true;
+	so->numKilled = 0;			/* just paranoia */
+	so->markItemIndex = -1;		/* ditto */
+
+	so->currPos.buf = _bt_getbuf(rel, blkno, BT_READ);
+	so->currPos.currPage = blkno;
+	page = BufferGetPage(so->currPos.buf);
+	opaque = (BTPageOpaque) PageGetSpecialPointer(page);
+
+	if (!P_IGNORE(opaque))
+	{
+		PredicateLockPage(rel, blkno, scan->xs_snapshot);
+		if (_bt_readpage(scan, dir, P_FIRSTDATAKEY(opaque)))
+		{
+			/* Drop the lock, and maybe the pin, on the current page */
+			_bt_drop_lock_and_maybe_pin(scan, &so->currPos);
+			return true;
+		}
+	}
+	else
+	{
+		/* deleted or half-dead page, so just pass on its right-link */
+		so->currPos.lastItem = -1;
+		_bt_parallel_release(scan, opaque->btpo_next);
+	}
+
+	/* Nothing here, so try to advance to the next page */
+	LockBuffer(so->currPos.buf, BUFFER_LOCK_UNLOCK);
+	return _bt_steppage(scan, dir);
+}
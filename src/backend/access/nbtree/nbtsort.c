@@ -55,6 +55,17 @@
  * This code isn't concerned about the FSM at all. The caller is responsible
  * for initializing that.
  *
+ * If max_parallel_maintenance_workers allows it and the heap is big enough,
+ * the scan and sort phase is done in parallel.  The leader and a number of
+ * background workers each claim blocks of the heap through a parallel heap
+ * scan, and sort what they find into spools of their own, using an equal
+ * share of maintenance_work_mem.  Each worker then streams its sorted tuples
+ * to the leader through a shm_mq, and the leader merges those streams and
+ * its own spools as it loads the leaf pages, so the pages themselves are
+ * still written by a single process.  For a unique index, each participant's
+ * sort checks for duplicates within its share of the heap, and the leader's
+ * merge checks for duplicates between shares.
+ *
  * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
  * Portions Copyright (c) 1994, Regents of the University of California
  *
@@ -66,17 +77,37 @@
 
 #include "postgres.h"
 
+#include "access/genam.h"
+#include "access/heapam.h"
 #include "access/nbtree.h"
+#include "access/parallel.h"
+#include "access/relscan.h"
+#include "access/xact.h"
 #include "access/xlog.h"
 #include "access/xloginsert.h"
+#include "catalog/index.h"
+#include "lib/binaryheap.h"
 #include "miscadmin.h"
+#include "storage/shm_mq.h"
 #include "storage/smgr.h"
+#include "storage/spin.h"
 #include "tcop/tcopprot.h"
 #include "utils/rel.h"
 #include "utils/sortsupport.h"
 #include "utils/tuplesort.h"
 
 
+/* Magic numbers for parallel index build state sharing */
+#define PARALLEL_KEY_BTREE_SHARED		UINT64CONST(0xA000000000000001)
+#define PARALLEL_KEY_TUPLE_QUEUE		UINT64CONST(0xA000000000000002)
+
+/* Size of each worker's queue of sorted tuples */
+#define PARALLEL_BTREE_QUEUE_SIZE		65536
+
+/* Minimum sort memory, in kilobytes, worth giving each participant */
+#define PARALLEL_BTREE_MIN_SORTMEM		32768
+
+
 /*
  * Status record for spooling/sorting phase.  (Note we may have two of
  * these due to the special requirements for uniqueness-checking with
@@ -90,6 +121,100 @@ struct BTSpool
 	bool		isunique;
 };
 
+/* Working state for btbuild and its callback */
+typedef struct
+{
+	bool		isUnique;
+	bool		haveDead;
+	Relation	heapRel;
+	BTSpool    *spool;
+
+	/*
+	 * spool2 is needed only when the index is a unique index. Dead tuples are
+	 * put into spool2 instead of spool in order to avoid uniqueness check.
+	 */
+	BTSpool    *spool2;
+	double		indtuples;
+} BTBuildState;
+
+/*
+ * Status record shared by the participants in a parallel index build.  It
+ * lives in the DSM segment set up by _bt_begin_parallel.
+ */
+typedef struct BTShared
+{
+	/* Fields set up by the leader and not changed afterwards */
+	Oid			heaprelid;
+	Oid			indexrelid;
+	int			sortmem;		/* sort memory for each participant, in kB */
+
+	/* Workers' results, added in under the mutex as each finishes its scan */
+	slock_t		mutex;
+	double		reltuples;		/* heap tuples seen by workers */
+	double		indtuples;		/* index tuples spooled by workers */
+	bool		brokenhotchain; /* did any worker see a broken HOT chain? */
+
+	/* The parallel heap scan that divides the heap between participants */
+	ParallelHeapScanDescData heapdesc;
+} BTShared;
+
+/*
+ * Leader's private state for a parallel index build.
+ */
+typedef struct BTLeader
+{
+	ParallelContext *pcxt;
+	BTShared   *btshared;
+	shm_mq_handle **queues;		/* tuple queue of each worker */
+	int			nqueues;		/* number of workers actually launched */
+} BTLeader;
+
+/*
+ * Each message on a worker's tuple queue starts with one of these, padded so
+ * that the IndexTuple following it (if any) is suitably aligned.
+ */
+typedef union BTQueueHeader
+{
+	char		kind;			/* one of the BTQ_xxx codes below */
+	char		pad[MAXIMUM_ALIGNOF];
+} BTQueueHeader;
+
+#define BTQ_LIVE		'l'		/* a live tuple follows */
+#define BTQ_DEAD		'd'		/* a dead tuple follows */
+#define BTQ_END			'e'		/* no more tuples */
+
+/*
+ * A sorted stream of index tuples to be merged by _bt_load.  A serial build
+ * has one or two of these, reading the spools; the leader of a parallel
+ * build also has one for each worker's tuple queue.
+ */
+typedef struct BTMergeSource
+{
+	BTSpool    *spool;			/* spool to read, or NULL */
+	bool		spooldead;		/* spool holds dead tuples only? */
+	shm_mq_handle *queue;		/* queue to read, if no spool */
+	IndexTuple	itup;			/* current tuple, or NULL once exhausted */
+	bool		isdead;			/* is current tuple dead? */
+	bool		should_free;	/* must current tuple be pfree'd? */
+} BTMergeSource;
+
+/*
+ * State for merging the streams.  When there is more than one, the one with
+ * the smallest current tuple is found with a binary heap of source numbers.
+ */
+typedef struct BTMergeState
+{
+	Relation	heap;
+	Relation	index;
+	int			nsources;
+	BTMergeSource *sources;
+	binaryheap *mergeheap;
+	SortSupport sortKeys;		/* for comparing tuples from different sources */
+	int			current;		/* source of last tuple returned, or -1 */
+	bool		checkunique;	/* check uniqueness across sources? */
+	IndexTuple	lastlive;		/* copy of last live tuple returned */
+} BTMergeState;
+
 /*
  * Status record for a btree page being built.  We have one of these
  * for each active tree level.
@@ -135,9 +260,41 @@ static void _bt_sortaddtup(Page page, Size itemsize,
 			   IndexTuple itup, OffsetNumber itup_off);
 static void _bt_buildadd(BTWriteState *wstate, BTPageState *state,
 			 IndexTuple itup);
+static void _bt_buildadd_posting(BTWriteState *wstate, BTPageState *state,
+					 IndexTuple base, ItemPointer htids, int nhtids);
+static int	_bt_tid_cmp(const void *a, const void *b);
 static void _bt_uppershutdown(BTWriteState *wstate, BTPageState *state);
-static void _bt_load(BTWriteState *wstate,
-		 BTSpool *btspool, BTSpool *btspool2);
+static void _bt_load(BTWriteState *wstate, BTMergeState *merge);
+static void btbuildCallback(Relation index,
+				HeapTuple htup,
+				Datum *values,
+				bool *isnull,
+				bool tupleIsAlive,
+				void *state);
+static BTSpool *_bt_spoolinit_mem(Relation heap, Relation index,
+				  bool isunique, int sortmem);
+static void _bt_spool_source(BTMergeSource *source, BTSpool *btspool,
+				 bool isdead);
+static void _bt_leafbuild_merge(Relation heap, Relation index,
+					BTMergeSource *sources, int nsources, bool checkunique);
+static BTMergeState *_bt_merge_begin(Relation heap, Relation index,
+				BTMergeSource *sources, int nsources, bool checkunique);
+static IndexTuple _bt_merge_next(BTMergeState *merge, bool *isdead);
+static void _bt_merge_end(BTMergeState *merge);
+static void _bt_merge_fetch(BTMergeSource *source);
+static int32 _bt_merge_compare(BTMergeState *merge, IndexTuple itup1,
+				  IndexTuple itup2, bool *equal_hasnull);
+static int	_bt_merge_heap_cmp(Datum a, Datum b, void *arg);
+static void _bt_merge_check_unique(BTMergeState *merge, IndexTuple itup);
+static int	_bt_parallel_degree(Relation heap, Relation index,
+					IndexInfo *indexInfo);
+static BTLeader *_bt_begin_parallel(Relation heap, Relation index,
+				   int nworkers);
+static void _bt_parallel_leafbuild(BTLeader *btleader, BTSpool *btspool,
+					   BTSpool *btspool2);
+static void _bt_end_parallel(BTLeader *btleader, IndexInfo *indexInfo,
+				 double *reltuples, double *indtuples);
+static void _bt_parallel_build_main(dsm_segment *seg, shm_toc *toc);
 
 
 /*
@@ -145,19 +302,153 @@ static void _bt_load(BTWriteState *wstate,
  */
 
 
+/*
+ *	btbuild() -- build a new btree index.
+ */
+Datum
+btbuild(PG_FUNCTION_ARGS)
+{
+	Relation	heap = (Relation) PG_GETARG_POINTER(0);
+	Relation	index = (Relation) PG_GETARG_POINTER(1);
+	IndexInfo  *indexInfo = (IndexInfo *) PG_GETARG_POINTER(2);
+	IndexBuildResult *result;
+	double		reltuples;
+	BTBuildState buildstate;
+	BTLeader   *btleader = NULL;
+	int			nworkers;
+	int			sortmem = maintenance_work_mem;
+
+	buildstate.isUnique = indexInfo->ii_Unique;
+	buildstate.haveDead = false;
+	buildstate.heapRel = heap;
+	buildstate.spool = NULL;
+	buildstate.spool2 = NULL;
+	buildstate.indtuples = 0;
+
+#ifdef BTREE_BUILD_STATS
+	if (log_btree_build_stats)
+		ResetUsage();
+#endif   /* BTREE_BUILD_STATS */
+
+	/*
+	 * We expect to be called exactly once for any index relation. If that's
+	 * not the case, big trouble's what we have.
+	 */
+	if (RelationGetNumberOfBlocks(index) != 0)
+		elog(ERROR, "index \"%s\" already contains data",
+			 RelationGetRelationName(index));
+
+	/*
+	 * If the build is worth doing in parallel, launch the workers.  They
+	 * start scanning as soon as they're up; the leader takes part in the scan
+	 * too, with the same share of memory as each of them.
+	 */
+	nworkers = _bt_parallel_degree(heap, index, indexInfo);
+	if (nworkers > 0)
+	{
+		btleader = _bt_begin_parallel(heap, index, nworkers);
+		sortmem = btleader->btshared->sortmem;
+	}
+
+	buildstate.spool = _bt_spoolinit_mem(heap, index, indexInfo->ii_Unique,
+										 sortmem);
+
+	/*
+	 * If building a unique index, put dead tuples in a second spool to keep
+	 * them out of the uniqueness check.
+	 */
+	if (indexInfo->ii_Unique)
+		buildstate.spool2 = _bt_spoolinit(heap, index, false, true);
+
+	/* do the heap scan */
+	if (btleader)
+		reltuples = IndexBuildHeapParallelScan(heap, index, indexInfo,
+											&btleader->btshared->heapdesc,
+									   btbuildCallback, (void *) &buildstate);
+	else
+		reltuples = IndexBuildHeapScan(heap, index, indexInfo, true,
+									   btbuildCallback, (void *) &buildstate);
+
+	/* okay, all heap tuples are indexed */
+	if (buildstate.spool2 && !buildstate.haveDead)
+	{
+		/* spool2 turns out to be unnecessary */
+		_bt_spooldestroy(buildstate.spool2);
+		buildstate.spool2 = NULL;
+	}
+
+	/*
+	 * Finish the build by (1) completing the sort of the spool file, (2)
+	 * inserting the sorted tuples into btree pages and (3) building the upper
+	 * levels.  In a parallel build, the workers' sorted tuples are merged in
+	 * during step (2).
+	 */
+	if (btleader)
+	{
+		_bt_parallel_leafbuild(btleader, buildstate.spool, buildstate.spool2);
+		_bt_end_parallel(btleader, indexInfo,
+						 &reltuples, &buildstate.indtuples);
+	}
+	else
+		_bt_leafbuild(buildstate.spool, buildstate.spool2);
+	_bt_spooldestroy(buildstate.spool);
+	if (buildstate.spool2)
+		_bt_spooldestroy(buildstate.spool2);
+
+#ifdef BTREE_BUILD_STATS
+	if (log_btree_build_stats)
+	{
+		ShowUsage("BTREE BUILD STATS");
+		ResetUsage();
+	}
+#endif   /* BTREE_BUILD_STATS */
+
+	/*
+	 * Return statistics
+	 */
+	result = (IndexBuildResult *) palloc(sizeof(IndexBuildResult));
+
+	result->heap_tuples = reltuples;
+	result->index_tuples = buildstate.indtuples;
+
+	PG_RETURN_POINTER(result);
+}
+
+/*
+ * Per-tuple callback from IndexBuildHeapScan
+ */
+static void
+btbuildCallback(Relation index,
+				HeapTuple htup,
+				Datum *values,
+				bool *isnull,
+				bool tupleIsAlive,
+				void *state)
+{
+	BTBuildState *buildstate = (BTBuildState *) state;
+
+	/*
+	 * insert the index tuple into the appropriate spool file for subsequent
+	 * processing
+	 */
+	if (tupleIsAlive || buildstate->spool2 == NULL)
+		_bt_spool(buildstate->spool, &htup->t_self, values, isnull);
+	else
+	{
+		/* dead tuples are put into spool2 */
+		buildstate->haveDead = true;
+		_bt_spool(buildstate->spool2, &htup->t_self, values, isnull);
+	}
+
+	buildstate->indtuples += 1;
+}
+
 /*
  * create and initialize a spool structure
  */
 BTSpool *
 _bt_spoolinit(Relation heap, Relation index, bool isunique, bool isdead)
 {
-	BTSpool    *btspool = (BTSpool *) palloc0(sizeof(BTSpool));
-	int			btKbytes;
-
-	btspool->heap = heap;
-	btspool->index = index;
-	btspool->isunique = isunique;
-
 	/*
 	 * We size the sort area as maintenance_work_mem rather than work_mem to
 	 * speed index creation.  This should be OK since a single backend can't
@@ -166,9 +457,23 @@ _bt_spoolinit(Relation heap, Relation index, bool isunique, bool isdead)
 	 * second one (for dead tuples) won't get very full, so we give it only
 	 * work_mem.
 	 */
-	btKbytes = isdead ? work_mem : maintenance_work_mem;
+	return _bt_spoolinit_mem(heap, index, isunique,
+							 isdead ? work_mem : maintenance_work_mem);
+}
+
+/*
+ * create a spool structure whose sort may use sortmem kilobytes
+ */
+static BTSpool *
+_bt_spoolinit_mem(Relation heap, Relation index, bool isunique, int sortmem)
+{
+	BTSpool    *btspool = (BTSpool *) palloc0(sizeof(BTSpool));
+
+	btspool->heap = heap;
+	btspool->index = index;
+	btspool->isunique = isunique;
 	btspool->sortstate = tuplesort_begin_index_btree(heap, index, isunique,
-													 btKbytes, false);
+													 sortmem, false);
 
 	return btspool;
 }
@@ -200,7 +505,8 @@ _bt_spool(BTSpool *btspool, ItemPointer self, Datum *values, bool *isnull)
 void
 _bt_leafbuild(BTSpool *btspool, BTSpool *btspool2)
 {
-	BTWriteState wstate;
+	BTMergeSource sources[2];
+	int			nsources = 0;
 
 #ifdef BTREE_BUILD_STATS
 	if (log_btree_build_stats)
@@ -211,11 +517,47 @@ _bt_leafbuild(BTSpool *btspool, BTSpool *btspool2)
 #endif   /* BTREE_BUILD_STATS */
 
 	tuplesort_performsort(btspool->sortstate);
+	_bt_spool_source(&sources[nsources++], btspool, false);
 	if (btspool2)
+	{
 		tuplesort_performsort(btspool2->sortstate);
+		_bt_spool_source(&sources[nsources++], btspool2, true);
+	}
+
+	/* The spool's own sort has checked uniqueness, if needed */
+	_bt_leafbuild_merge(btspool->heap, btspool->index,
+						sources, nsources, false);
+}
 
-	wstate.heap = btspool->heap;
-	wstate.index = btspool->index;
+
+/*
+ * Internal routines.
+ */
+
+
+/*
+ * set up a merge source that reads a sorted spool
+ */
+static void
+_bt_spool_source(BTMergeSource *source, BTSpool *btspool, bool isdead)
+{
+	memset(source, 0, sizeof(BTMergeSource));
+	source->spool = btspool;
+	source->spooldead = isdead;
+}
+
+/*
+ * load the merged contents of the given sources into a new btree
+ */
+static void
+_bt_leafbuild_merge(Relation heap, Relation index,
+					BTMergeSource *sources, int nsources, bool checkunique)
+{
+	BTWriteState wstate;
+	BTMergeState *merge;
+
+	wstate.heap = heap;
+	wstate.index = index;
 
 	/*
 	 * We need to log index creation in WAL iff WAL archiving/streaming is
@@ -228,15 +570,12 @@ _bt_leafbuild(BTSpool *btspool, BTSpool *btspool2)
 	wstate.btws_pages_written = 0;
 	wstate.btws_zeropage = NULL;	/* until needed */
 
-	_bt_load(&wstate, btspool, btspool2);
+	merge = _bt_merge_begin(heap, index, sources, nsources, checkunique);
+	_bt_load(&wstate, merge);
+	_bt_merge_end(merge);
 }
 
 
-/*
- * Internal routines.
- */
-
-
 /*
  * allocate workspace for a new, clean btree page, not linked to any siblings.
  */
@@ -510,6 +849,7 @@ _bt_buildadd(BTWriteState *wstate, BTPageState *state, IndexTuple itup)
 		ItemId		ii;
 		ItemId		hii;
 		IndexTuple	oitup;
+		IndexTuple	minkey;
 
 		/* Create new page of same level */
 		npage = _bt_blnewpage(state->btps_level);
@@ -529,6 +869,25 @@ _bt_buildadd(BTWriteState *wstate, BTPageState *state, IndexTuple itup)
 		oitup = (IndexTuple) PageGetItem(opage, ii);
 		_bt_sortaddtup(npage, ItemIdGetLength(ii), oitup, P_FIRSTKEY);
 
+		/*
+		 * Save a copy of the minimum key for the new page.  We have to copy
+		 * it off the old page, not the new one, in case we are not at leaf
+		 * level.  On the leaf level, it only has to separate the old page
+		 * from the new one, so it is truncated to as few attributes as will
+		 * do that; this also leaves out any posting list.
+		 */
+		if (state->btps_level == 0)
+		{
+			IndexTuple	lastleft;
+
+			ii = PageGetItemId(opage, OffsetNumberPrev(last_off));
+			lastleft = (IndexTuple) PageGetItem(opage, ii);
+			minkey = _bt_truncate(wstate->index, lastleft, oitup);
+			ii = PageGetItemId(opage, last_off);
+		}
+		else
+			minkey = CopyIndexTuple(oitup);
+
 		/*
 		 * Move 'last' into the high key position on opage
 		 */
@@ -537,6 +896,13 @@ _bt_buildadd(BTWriteState *wstate, BTPageState *state, IndexTuple itup)
 		ItemIdSetUnused(ii);	/* redundant */
 		((PageHeader) opage)->pd_lower -= sizeof(ItemIdData);
 
+		/* on the leaf level, the high key is the truncated copy */
+		if (state->btps_level == 0)
+		{
+			PageIndexTupleDelete(opage, P_HIKEY);
+			_bt_sortaddtup(opage, IndexTupleSize(minkey), minkey, P_HIKEY);
+		}
+
 		/*
 		 * Link the old page into its parent, using its minimum key. If we
 		 * don't have a parent, we have to create one; this adds a new btree
@@ -546,16 +912,11 @@ _bt_buildadd(BTWriteState *wstate, BTPageState *state, IndexTuple itup)
 			state->btps_next = _bt_pagestate(wstate, state->btps_level + 1);
 
 		Assert(state->btps_minkey != NULL);
-		ItemPointerSet(&(state->btps_minkey->t_tid), oblkno, P_HIKEY);
+		BTreeTupleSetDownLink(state->btps_minkey, oblkno);
 		_bt_buildadd(wstate, state->btps_next, state->btps_minkey);
 		pfree(state->btps_minkey);
 
-		/*
-		 * Save a copy of the minimum key for the new page.  We have to copy
-		 * it off the old page, not the new one, in case we are not at leaf
-		 * level.
-		 */
-		state->btps_minkey = CopyIndexTuple(oitup);
+		state->btps_minkey = minkey;
 
 		/*
 		 * Set the sibling links for both pages.
@@ -590,7 +951,10 @@ _bt_buildadd(BTWriteState *wstate, BTPageState *state, IndexTuple itup)
 	if (last_off == P_HIKEY)
 	{
 		Assert(state->btps_minkey == NULL);
-		state->btps_minkey = CopyIndexTuple(itup);
+		if (state->btps_level == 0)
+			state->btps_minkey = _bt_key_copy(itup);
+		else
+			state->btps_minkey = CopyIndexTuple(itup);
 	}
 
 	/*
@@ -643,7 +1007,7 @@ _bt_uppershutdown(BTWriteState *wstate, BTPageState *state)
 		else
 		{
 			Assert(s->btps_minkey != NULL);
-			ItemPointerSet(&(s->btps_minkey->t_tid), blkno, P_HIKEY);
+			BTreeTupleSetDownLink(s->btps_minkey, blkno);
 			_bt_buildadd(wstate, s->btps_next, s->btps_minkey);
 			pfree(s->btps_minkey);
 			s->btps_minkey = NULL;
@@ -670,45 +1034,164 @@ _bt_uppershutdown(BTWriteState *wstate, BTPageState *state)
 }
 
 /*
- * Read tuples in correct sort order from tuplesort, and load them into
+ * Add a run of leaf items with equal keys to the index being built, as a
+ * single posting list tuple if there is more than one of them.
+ */
+static void
+_bt_buildadd_posting(BTWriteState *wstate, BTPageState *state,
+					 IndexTuple base, ItemPointer htids, int nhtids)
+{
+	IndexTuple	itup;
+
+	if (nhtids == 1)
+	{
+		_bt_buildadd(wstate, state, base);
+		return;
+	}
+
+	/* a parallel build's merge doesn't promise TID order among equal keys */
+	qsort(htids, nhtids, sizeof(ItemPointerData), _bt_tid_cmp);
+	itup = _bt_form_posting(base, htids, nhtids);
+	_bt_buildadd(wstate, state, itup);
+	pfree(itup);
+}
+
+/*
+ * qsort comparator for heap TIDs
+ */
+static int
+_bt_tid_cmp(const void *a, const void *b)
+{
+	return ItemPointerCompare((ItemPointer) a, (ItemPointer) b);
+}
+
+/*
+ * Read tuples in correct sort order from the merge, and load them into
  * btree leaves.
+ *
+ * In a non-unique index, runs of tuples with the same key are merged into
+ * posting list tuples on the way; see nbtdedup.c.
  */
 static void
-_bt_load(BTWriteState *wstate, BTSpool *btspool, BTSpool *btspool2)
+_bt_load(BTWriteState *wstate, BTMergeState *merge)
 {
 	BTPageState *state = NULL;
-	bool		merge = (btspool2 != NULL);
-	IndexTuple	itup,
-				itup2 = NULL;
-	bool		should_free,
-				should_free2,
-				load1;
-	TupleDesc	tupdes = RelationGetDescr(wstate->index);
-	int			i,
-				keysz = RelationGetNumberOfAttributes(wstate->index);
-	ScanKey		indexScanKey = NULL;
-	SortSupport sortKeys;
-
-	if (merge)
+	IndexTuple	itup;
+	bool		deduplicate = !wstate->index->rd_index->indisunique;
+	IndexTuple	base = NULL;
+	ItemPointer htids = NULL;
+	int			nhtids = 0;
+	Size		maxpostingsize = 0;
+
+	while ((itup = _bt_merge_next(merge, NULL)) != NULL)
 	{
-		/*
-		 * Another BTSpool for dead tuples exists. Now we have to merge
-		 * btspool and btspool2.
-		 */
+		/* When we see first tuple, create first index page */
+		if (state == NULL)
+		{
+			state = _bt_pagestate(wstate, 0);
+			if (deduplicate)
+			{
+				maxpostingsize = BTMaxPostingSize(state->btps_page);
+				htids = (ItemPointer) palloc(maxpostingsize);
+			}
+		}
 
-		/* the preparation of merge */
-		itup = tuplesort_getindextuple(btspool->sortstate,
-									   true, &should_free);
-		itup2 = tuplesort_getindextuple(btspool2->sortstate,
-										true, &should_free2);
-		indexScanKey = _bt_mkscankey_nodata(wstate->index);
+		if (!deduplicate)
+		{
+			_bt_buildadd(wstate, state, itup);
+			continue;
+		}
+
+		/* add this tuple's TID to the current run, if we can */
+		if (base != NULL && _bt_keys_equal(base, itup) &&
+			BTreeTupleGetKeySize(base) +
+			(nhtids + 1) * sizeof(ItemPointerData) <= maxpostingsize)
+		{
+			htids[nhtids++] = itup->t_tid;
+			continue;
+		}
+
+		/* otherwise, write out the current run and start a new one */
+		if (base != NULL)
+		{
+			_bt_buildadd_posting(wstate, state, base, htids, nhtids);
+			pfree(base);
+		}
+		base = CopyIndexTuple(itup);
+		htids[0] = itup->t_tid;
+		nhtids = 1;
+	}
+
+	if (base != NULL)
+	{
+		_bt_buildadd_posting(wstate, state, base, htids, nhtids);
+		pfree(base);
+	}
+	if (htids != NULL)
+		pfree(htids);
+
+	/* Close down final pages and write the metapage */
+	_bt_uppershutdown(wstate, state);
+
+	/*
+	 * If the index is WAL-logged, we must fsync it down to disk before it's
+	 * safe to commit the transaction.  (For a non-WAL-logged index we don't
+	 * care since the index will be uninteresting after a crash anyway.)
+	 *
+	 * It's obvious that we must do this when not WAL-logging the build. It's
+	 * less obvious that we have to do it even if we did WAL-log the index
+	 * pages.  The reason is that since we're building outside shared buffers,
+	 * a CHECKPOINT occurring during the build has no way to flush the
+	 * previously written data to disk (indeed it won't know the index even
+	 * exists).  A crash later on would replay WAL from the checkpoint,
+	 * therefore it wouldn't replay our earlier WAL entries. If we do not
+	 * fsync those pages here, they might still not be on disk when the crash
+	 * occurs.
+	 */
+	if (RelationNeedsWAL(wstate->index))
+	{
+		RelationOpenSmgr(wstate->index);
+		smgrimmedsync(wstate->index->rd_smgr, MAIN_FORKNUM);
+	}
+}
+
+/*
+ * Set up to merge the sorted streams of the given sources.
+ *
+ * If checkunique is true, the merge raises an error if two live tuples with
+ * equal keys (and no nulls) come from different sources.  This is needed
+ * only when the sources hold different parts of the heap; a spool's own sort
+ * already checks the tuples it was given.
+ */
+static BTMergeState *
+_bt_merge_begin(Relation heap, Relation index,
+				BTMergeSource *sources, int nsources, bool checkunique)
+{
+	BTMergeState *merge = (BTMergeState *) palloc0(sizeof(BTMergeState));
+	int			keysz = IndexRelationGetNumberOfKeyAttributes(index);
+	int			i;
+
+	merge->heap = heap;
+	merge->index = index;
+	merge->nsources = nsources;
+	merge->sources = sources;
+	merge->current = -1;
+	merge->checkunique = checkunique;
+
+	/* Prime each source with its first tuple */
+	for (i = 0; i < nsources; i++)
+		_bt_merge_fetch(&sources[i]);
+
+	if (nsources > 1)
+	{
+		ScanKey		indexScanKey = _bt_mkscankey_nodata(index);
 
 		/* Prepare SortSupport data for each column */
-		sortKeys = (SortSupport) palloc0(keysz * sizeof(SortSupportData));
+		merge->sortKeys = (SortSupport) palloc0(keysz * sizeof(SortSupportData));
 
 		for (i = 0; i < keysz; i++)
 		{
-			SortSupport sortKey = sortKeys + i;
+			SortSupport sortKey = merge->sortKeys + i;
 			ScanKey		scanKey = indexScanKey + i;
 			int16		strategy;
 
@@ -725,109 +1208,500 @@ _bt_load(BTWriteState *wstate, BTSpool *btspool, BTSpool *btspool2)
 			strategy = (scanKey->sk_flags & SK_BT_DESC) != 0 ?
 				BTGreaterStrategyNumber : BTLessStrategyNumber;
 
-			PrepareSortSupportFromIndexRel(wstate->index, strategy, sortKey);
+			PrepareSortSupportFromIndexRel(index, strategy, sortKey);
 		}
 
 		_bt_freeskey(indexScanKey);
 
-		for (;;)
+		/* Build a heap of the sources that aren't already empty */
+		merge->mergeheap = binaryheap_allocate(nsources, _bt_merge_heap_cmp,
+											   merge);
+		for (i = 0; i < nsources; i++)
 		{
-			load1 = true;		/* load BTSpool next ? */
-			if (itup2 == NULL)
-			{
-				if (itup == NULL)
-					break;
-			}
-			else if (itup != NULL)
-			{
-				for (i = 1; i <= keysz; i++)
-				{
-					SortSupport entry;
-					Datum		attrDatum1,
-								attrDatum2;
-					bool		isNull1,
-								isNull2;
-					int32		compare;
-
-					entry = sortKeys + i - 1;
-					attrDatum1 = index_getattr(itup, i, tupdes, &isNull1);
-					attrDatum2 = index_getattr(itup2, i, tupdes, &isNull2);
-
-					compare = ApplySortComparator(attrDatum1, isNull1,
-												  attrDatum2, isNull2,
-												  entry);
-					if (compare > 0)
-					{
-						load1 = false;
-						break;
-					}
-					else if (compare < 0)
-						break;
-				}
-			}
-			else
-				load1 = false;
+			if (sources[i].itup != NULL)
+				binaryheap_add_unordered(merge->mergeheap, Int32GetDatum(i));
+		}
+		binaryheap_build(merge->mergeheap);
+	}
 
-			/* When we see first tuple, create first index page */
-			if (state == NULL)
-				state = _bt_pagestate(wstate, 0);
+	return merge;
+}
 
-			if (load1)
-			{
-				_bt_buildadd(wstate, state, itup);
-				if (should_free)
-					pfree(itup);
-				itup = tuplesort_getindextuple(btspool->sortstate,
-											   true, &should_free);
-			}
+/*
+ * Return the next tuple of the merge, or NULL when all sources are
+ * exhausted.  If isdead isn't NULL, *isdead is set to whether the tuple
+ * came from a dead tuple spool.
+ *
+ * The tuple is valid only until the next call.
+ */
+static IndexTuple
+_bt_merge_next(BTMergeState *merge, bool *isdead)
+{
+	BTMergeSource *source;
+
+	/* Advance past the tuple returned by the last call */
+	if (merge->current >= 0)
+	{
+		source = &merge->sources[merge->current];
+		if (source->should_free)
+			pfree(source->itup);
+		_bt_merge_fetch(source);
+
+		if (merge->mergeheap != NULL)
+		{
+			if (source->itup != NULL)
+				binaryheap_replace_first(merge->mergeheap,
+										 Int32GetDatum(merge->current));
 			else
-			{
-				_bt_buildadd(wstate, state, itup2);
-				if (should_free2)
-					pfree(itup2);
-				itup2 = tuplesort_getindextuple(btspool2->sortstate,
-												true, &should_free2);
-			}
+				(void) binaryheap_remove_first(merge->mergeheap);
 		}
-		pfree(sortKeys);
 	}
+
+	/* Find the source with the smallest current tuple */
+	if (merge->mergeheap == NULL)
+		merge->current = merge->sources[0].itup != NULL ? 0 : -1;
+	else if (binaryheap_empty(merge->mergeheap))
+		merge->current = -1;
 	else
+		merge->current = DatumGetInt32(binaryheap_first(merge->mergeheap));
+
+	if (merge->current < 0)
+		return NULL;
+	source = &merge->sources[merge->current];
+
+	if (merge->checkunique && !source->isdead)
+		_bt_merge_check_unique(merge, source->itup);
+
+	if (isdead)
+		*isdead = source->isdead;
+	return source->itup;
+}
+
+/*
+ * Release a merge's resources.  The sources themselves belong to the caller.
+ */
+static void
+_bt_merge_end(BTMergeState *merge)
+{
+	int			i;
+
+	for (i = 0; i < merge->nsources; i++)
 	{
-		/* merge is unnecessary */
-		while ((itup = tuplesort_getindextuple(btspool->sortstate,
-											   true, &should_free)) != NULL)
-		{
-			/* When we see first tuple, create first index page */
-			if (state == NULL)
-				state = _bt_pagestate(wstate, 0);
+		BTMergeSource *source = &merge->sources[i];
 
-			_bt_buildadd(wstate, state, itup);
-			if (should_free)
-				pfree(itup);
+		if (source->itup != NULL && source->should_free)
+			pfree(source->itup);
+		source->itup = NULL;
+	}
+	if (merge->mergeheap)
+		binaryheap_free(merge->mergeheap);
+	if (merge->sortKeys)
+		pfree(merge->sortKeys);
+	if (merge->lastlive)
+		pfree(merge->lastlive);
+	pfree(merge);
+}
+
+/*
+ * Read the next tuple of a source into source->itup, setting it to NULL at
+ * the end of the source.
+ */
+static void
+_bt_merge_fetch(BTMergeSource *source)
+{
+	shm_mq_result res;
+	Size		nbytes;
+	void	   *data;
+	BTQueueHeader *header;
+
+	if (source->spool != NULL)
+	{
+		source->itup = tuplesort_getindextuple(source->spool->sortstate,
+											   true, &source->should_free);
+		source->isdead = source->spooldead;
+		return;
+	}
+
+	/* Wait for the worker to send its next tuple */
+	res = shm_mq_receive(source->queue, &nbytes, &data, false);
+	if (res != SHM_MQ_SUCCESS)
+	{
+		/*
+		 * The worker went away before telling us it was done.  If that was
+		 * because of an error, it has left a message for us; rethrow it.
+		 */
+		HandleParallelMessages();
+		ereport(ERROR,
+				(errcode(ERRCODE_INTERNAL_ERROR),
+				 errmsg("lost connection to parallel worker")));
+	}
+
+	header = (BTQueueHeader *) data;
+	source->should_free = false;
+	if (header->kind == BTQ_END)
+	{
+		source->itup = NULL;
+		return;
+	}
+
+	Assert(header->kind == BTQ_LIVE || header->kind == BTQ_DEAD);
+	Assert(nbytes > sizeof(BTQueueHeader));
+	source->itup = (IndexTuple) ((char *) data + sizeof(BTQueueHeader));
+	source->isdead = (header->kind == BTQ_DEAD);
+}
+
+/*
+ * Compare two index tuples by their keys.  If equal_hasnull isn't NULL and
+ * the tuples are equal, *equal_hasnull is set to whether any key was null.
+ */
+static int32
+_bt_merge_compare(BTMergeState *merge, IndexTuple itup1, IndexTuple itup2,
+				  bool *equal_hasnull)
+{
+	TupleDesc	tupdes = RelationGetDescr(merge->index);
+	int			keysz = IndexRelationGetNumberOfKeyAttributes(merge->index);
+	bool		hasnull = false;
+	int			i;
+
+	for (i = 1; i <= keysz; i++)
+	{
+		SortSupport entry;
+		Datum		attrDatum1,
+					attrDatum2;
+		bool		isNull1,
+					isNull2;
+		int32		compare;
+
+		entry = merge->sortKeys + i - 1;
+		attrDatum1 = index_getattr(itup1, i, tupdes, &isNull1);
+		attrDatum2 = index_getattr(itup2, i, tupdes, &isNull2);
+
+		compare = ApplySortComparator(attrDatum1, isNull1,
+									  attrDatum2, isNull2,
+									  entry);
+		if (compare != 0)
+			return compare;
+		if (isNull1)
+			hasnull = true;
+	}
+
+	if (equal_hasnull)
+		*equal_hasnull = hasnull;
+	return 0;
+}
+
+/*
+ * binaryheap comparator for source numbers.  binaryheap is a max-heap, so
+ * this reverses the sense of the tuple comparison to keep the source with
+ * the smallest current tuple on top.
+ */
+static int
+_bt_merge_heap_cmp(Datum a, Datum b, void *arg)
+{
+	BTMergeState *merge = (BTMergeState *) arg;
+	BTMergeSource *source1 = &merge->sources[DatumGetInt32(a)];
+	BTMergeSource *source2 = &merge->sources[DatumGetInt32(b)];
+	int32		compare;
+
+	compare = _bt_merge_compare(merge, source1->itup, source2->itup, NULL);
+	if (compare > 0)
+		return -1;
+	if (compare < 0)
+		return 1;
+
+	/* Keep the merge deterministic when keys are equal */
+	return DatumGetInt32(b) - DatumGetInt32(a);
+}
+
+/*
+ * Check that a live tuple about to be loaded doesn't duplicate the previous
+ * live tuple.  Since the merge returns tuples in order, that's enough to
+ * find duplicates from different sources.
+ */
+static void
+_bt_merge_check_unique(BTMergeState *merge, IndexTuple itup)
+{
+	if (merge->lastlive != NULL)
+	{
+		bool		hasnull;
+
+		if (_bt_merge_compare(merge, merge->lastlive, itup, &hasnull) == 0 &&
+			!hasnull)
+		{
+			Datum		values[INDEX_MAX_KEYS];
+			bool		isnull[INDEX_MAX_KEYS];
+			char	   *key_desc;
+
+			index_deform_tuple(itup, RelationGetDescr(merge->index),
+							   values, isnull);
+			key_desc = BuildIndexValueDescription(merge->index, values, isnull);
+
+			ereport(ERROR,
+					(errcode(ERRCODE_UNIQUE_VIOLATION),
+					 errmsg("could not create unique index \"%s\"",
+							RelationGetRelationName(merge->index)),
+					 key_desc ? errdetail("Key %s is duplicated.", key_desc) :
+					 errdetail("Duplicate keys exist."),
+					 errtableconstraint(merge->heap,
+								   RelationGetRelationName(merge->index))));
 		}
+		pfree(merge->lastlive);
 	}
+	merge->lastlive = CopyIndexTuple(itup);
+}
 
-	/* Close down final pages and write the metapage */
-	_bt_uppershutdown(wstate, state);
+/*
+ * Decide how many workers to use for building the given index, or 0 if the
+ * build shouldn't be done in parallel.
+ */
+static int
+_bt_parallel_degree(Relation heap, Relation index, IndexInfo *indexInfo)
+{
+	int			nworkers;
+
+	nworkers = IndexBuildParallelWorkers(heap, indexInfo);
+
+	/* Don't split maintenance_work_mem into uselessly small shares */
+	while (nworkers > 0 &&
+		   maintenance_work_mem / (nworkers + 1) < PARALLEL_BTREE_MIN_SORTMEM)
+		nworkers--;
+
+	return nworkers;
+}
+
+/*
+ * Enter parallel mode and launch workers to help build the index.
+ *
+ * Fewer workers than requested may actually start, perhaps none; the
+ * leader still gets only its share of maintenance_work_mem in that case,
+ * since the shares are fixed before the workers are launched.
+ */
+static BTLeader *
+_bt_begin_parallel(Relation heap, Relation index, int nworkers)
+{
+	BTLeader   *btleader = (BTLeader *) palloc0(sizeof(BTLeader));
+	ParallelContext *pcxt;
+	BTShared   *btshared;
+	char	   *tqueuespace;
+	int			i;
+
+	EnterParallelMode();
+	pcxt = CreateParallelContext(_bt_parallel_build_main, nworkers);
+
+	/* Estimate space for the shared state and the tuple queues */
+	shm_toc_estimate_chunk(&pcxt->estimator, sizeof(BTShared));
+	shm_toc_estimate_chunk(&pcxt->estimator,
+						   PARALLEL_BTREE_QUEUE_SIZE * pcxt->nworkers);
+	shm_toc_estimate_keys(&pcxt->estimator, 2);
+
+	InitializeParallelDSM(pcxt);
+
+	/* Set up the shared state */
+	btshared = (BTShared *) shm_toc_allocate(pcxt->toc, sizeof(BTShared));
+	btshared->heaprelid = RelationGetRelid(heap);
+	btshared->indexrelid = RelationGetRelid(index);
+	btshared->sortmem = maintenance_work_mem / (nworkers + 1);
+	SpinLockInit(&btshared->mutex);
+	btshared->reltuples = 0;
+	btshared->indtuples = 0;
+	btshared->brokenhotchain = false;
+	heap_parallelscan_initialize(&btshared->heapdesc, heap);
+	shm_toc_insert(pcxt->toc, PARALLEL_KEY_BTREE_SHARED, btshared);
+
+	/* Set up a tuple queue for each worker, with the leader receiving */
+	tqueuespace = shm_toc_allocate(pcxt->toc,
+								   PARALLEL_BTREE_QUEUE_SIZE * pcxt->nworkers);
+	for (i = 0; i < pcxt->nworkers; i++)
+	{
+		shm_mq	   *mq;
+
+		mq = shm_mq_create(tqueuespace + i * PARALLEL_BTREE_QUEUE_SIZE,
+						   (Size) PARALLEL_BTREE_QUEUE_SIZE);
+		shm_mq_set_receiver(mq, MyProc);
+	}
+	shm_toc_insert(pcxt->toc, PARALLEL_KEY_TUPLE_QUEUE, tqueuespace);
+
+	LaunchParallelWorkers(pcxt);
+
+	/* Attach to the queues of the workers that actually started */
+	btleader->pcxt = pcxt;
+	btleader->btshared = btshared;
+	btleader->nqueues = pcxt->nworkers_launched;
+	btleader->queues = (shm_mq_handle **)
+		palloc0(Max(pcxt->nworkers_launched, 1) * sizeof(shm_mq_handle *));
+	for (i = 0; i < pcxt->nworkers_launched; i++)
+	{
+		shm_mq	   *mq = (shm_mq *) (tqueuespace + i * PARALLEL_BTREE_QUEUE_SIZE);
+
+		btleader->queues[i] = shm_mq_attach(mq, pcxt->seg, NULL);
+		shm_mq_set_handle(btleader->queues[i], pcxt->worker[i].bgwhandle);
+	}
+
+	return btleader;
+}
+
+/*
+ * Leader's counterpart of _bt_leafbuild: sort the leader's own spools, and
+ * load the btree from the merge of those and the workers' tuple queues.
+ */
+static void
+_bt_parallel_leafbuild(BTLeader *btleader, BTSpool *btspool,
+					   BTSpool *btspool2)
+{
+	BTMergeSource *sources;
+	int			nsources = 0;
+	int			i;
+
+	sources = (BTMergeSource *)
+		palloc0((btleader->nqueues + 2) * sizeof(BTMergeSource));
+
+	tuplesort_performsort(btspool->sortstate);
+	_bt_spool_source(&sources[nsources++], btspool, false);
+	if (btspool2)
+	{
+		tuplesort_performsort(btspool2->sortstate);
+		_bt_spool_source(&sources[nsources++], btspool2, true);
+	}
+	for (i = 0; i < btleader->nqueues; i++)
+		sources[nsources++].queue = btleader->queues[i];
+
+	_bt_leafbuild_merge(btspool->heap, btspool->index, sources, nsources,
+						btspool->isunique && btleader->nqueues > 0);
+	pfree(sources);
+}
+
+/*
+ * Wait for the workers to finish, add their counts to the leader's, and
+ * leave parallel mode.
+ */
+static void
+_bt_end_parallel(BTLeader *btleader, IndexInfo *indexInfo,
+				 double *reltuples, double *indtuples)
+{
+	BTShared   *btshared = btleader->btshared;
+
+	WaitForParallelWorkersToFinish(btleader->pcxt);
+
+	/* The workers are gone, so no need for the spinlock */
+	*reltuples += btshared->reltuples;
+	*indtuples += btshared->indtuples;
+	if (btshared->brokenhotchain)
+		indexInfo->ii_BrokenHotChain = true;
+
+	DestroyParallelContext(btleader->pcxt);
+	ExitParallelMode();
+	pfree(btleader->queues);
+	pfree(btleader);
+}
+
+/*
+ * Main entry point for a parallel index build worker.
+ *
+ * The worker scans the blocks of the heap it's handed, sorts what it finds,
+ * and sends the sorted tuples to the leader.  It has no lock of its own on
+ * the heap or the index; the leader's lock protects both until the leader
+ * has received everything and the worker has exited.
+ */
+static void
+_bt_parallel_build_main(dsm_segment *seg, shm_toc *toc)
+{
+	BTShared   *btshared;
+	char	   *tqueuespace;
+	shm_mq	   *mq;
+	shm_mq_handle *mqh;
+	Relation	heapRel;
+	Relation	indexRel;
+	IndexInfo  *indexInfo;
+	BTBuildState buildstate;
+	double		reltuples;
+	BTMergeSource sources[2];
+	int			nsources = 0;
+	BTMergeState *merge;
+	IndexTuple	itup;
+	bool		isdead;
+
+	btshared = (BTShared *) shm_toc_lookup(toc, PARALLEL_KEY_BTREE_SHARED);
+	tqueuespace = shm_toc_lookup(toc, PARALLEL_KEY_TUPLE_QUEUE);
+	if (btshared == NULL || tqueuespace == NULL)
+		elog(ERROR, "could not find parallel index build state");
+
+	mq = (shm_mq *) (tqueuespace +
+					 ParallelWorkerNumber * PARALLEL_BTREE_QUEUE_SIZE);
+	shm_mq_set_sender(mq, MyProc);
+	mqh = shm_mq_attach(mq, seg, NULL);
+
+	heapRel = heap_open(btshared->heaprelid, NoLock);
+	indexRel = index_open(btshared->indexrelid, NoLock);
+	indexInfo = BuildIndexInfo(indexRel);
+
+	buildstate.isUnique = indexInfo->ii_Unique;
+	buildstate.haveDead = false;
+	buildstate.heapRel = heapRel;
+	buildstate.spool = _bt_spoolinit_mem(heapRel, indexRel,
+										 indexInfo->ii_Unique,
+										 btshared->sortmem);
+	buildstate.spool2 = NULL;
+	if (indexInfo->ii_Unique)
+		buildstate.spool2 = _bt_spoolinit(heapRel, indexRel, false, true);
+	buildstate.indtuples = 0;
+
+	/* Scan our share of the heap and sort it */
+	reltuples = IndexBuildHeapParallelScan(heapRel, indexRel, indexInfo,
+										   &btshared->heapdesc,
+									   btbuildCallback, (void *) &buildstate);
+
+	tuplesort_performsort(buildstate.spool->sortstate);
+	_bt_spool_source(&sources[nsources++], buildstate.spool, false);
+	if (buildstate.spool2)
+	{
+		tuplesort_performsort(buildstate.spool2->sortstate);
+		_bt_spool_source(&sources[nsources++], buildstate.spool2, true);
+	}
+
+	/* Report our counts to the leader */
+	SpinLockAcquire(&btshared->mutex);
+	btshared->reltuples += reltuples;
+	btshared->indtuples += buildstate.indtuples;
+	if (indexInfo->ii_BrokenHotChain)
+		btshared->brokenhotchain = true;
+	SpinLockRelease(&btshared->mutex);
 
 	/*
-	 * If the index is WAL-logged, we must fsync it down to disk before it's
-	 * safe to commit the transaction.  (For a non-WAL-logged index we don't
-	 * care since the index will be uninteresting after a crash anyway.)
-	 *
-	 * It's obvious that we must do this when not WAL-logging the build. It's
-	 * less obvious that we have to do it even if we did WAL-log the index
-	 * pages.  The reason is that since we're building outside shared buffers,
-	 * a CHECKPOINT occurring during the build has no way to flush the
-	 * previously written data to disk (indeed it won't know the index even
-	 * exists).  A crash later on would replay WAL from the checkpoint,
-	 * therefore it wouldn't replay our earlier WAL entries. If we do not
-	 * fsync those pages here, they might still not be on disk when the crash
-	 * occurs.
+	 * Send the sorted tuples to the leader.  If the leader detaches from the
+	 * queue, it must have failed, and it has no further use for them.
 	 */
-	if (RelationNeedsWAL(wstate->index))
+	merge = _bt_merge_begin(heapRel, indexRel, sources, nsources, false);
+	for (;;)
 	{
-		RelationOpenSmgr(wstate->index);
-		smgrimmedsync(wstate->index->rd_smgr, MAIN_FORKNUM);
+		BTQueueHeader header;
+		shm_mq_iovec iov[2];
+		int			iovcnt = 1;
+
+		itup = _bt_merge_next(merge, &isdead);
+
+		memset(&header, 0, sizeof(header));
+		iov[0].data = (char *) &header;
+		iov[0].len = sizeof(header);
+		if (itup == NULL)
+			header.kind = BTQ_END;
+		else
+		{
+			header.kind = isdead ? BTQ_DEAD : BTQ_LIVE;
+			iov[1].data = (char *) itup;
+			iov[1].len = IndexTupleSize(itup);
+			iovcnt = 2;
+		}
+
+		if (shm_mq_sendv(mqh, iov, iovcnt, false) != SHM_MQ_SUCCESS ||
+			itup == NULL)
+			break;
 	}
+	_bt_merge_end(merge);
+
+	_bt_spooldestroy(buildstate.spool);
+	if (buildstate.spool2)
+		_bt_spooldestroy(buildstate.spool2);
+
+	index_close(indexRel, NoLock);
+	heap_close(heapRel, NoLock);
 }
@@ -22,6 +22,7 @@
 #include "access/relscan.h"
 #include "miscadmin.h"
 #include "utils/array.h"
+#include "utils/datum.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
@@ -45,10 +46,15 @@ static bool _bt_compare_scankey_args(IndexScanDesc scan, ScanKey op,
 						 ScanKey leftarg, ScanKey rightarg,
 						 bool *result);
 static bool _bt_fix_scankey_strategy(ScanKey skey, int16 *indoption);
+static void _bt_init_skip_key(IndexScanDesc scan);
 static void _bt_mark_scankey_required(ScanKey skey);
 static bool _bt_check_rowcompare(ScanKey skey,
 					 IndexTuple tuple, TupleDesc tupdesc,
 					 ScanDirection dir, bool *continuescan);
+static ScanKey _bt_mkscankey_natts(Relation rel, IndexTuple itup, int natts);
+static bool _bt_posting_contains(IndexTuple itup, ItemPointer htid);
+static bool _bt_posting_all_killed(BTScanOpaque so, int numKilled,
+					   IndexTuple itup);
 
 
 /*
@@ -56,22 +62,50 @@ static bool _bt_check_rowcompare(ScanKey skey,
  *		Build an insertion scan key that contains comparison data from itup
  *		as well as comparator routines appropriate to the key datatypes.
  *
- *		The result is intended for use with _bt_compare().
+ *		The result is intended for use with _bt_compare().  itup must not
+ *		be a truncated pivot tuple; see _bt_mkscankey_pivot for those.
+ *		Only key attributes get entries; non-key INCLUDE columns have no
+ *		comparator.
  */
 ScanKey
 _bt_mkscankey(Relation rel, IndexTuple itup)
+{
+	return _bt_mkscankey_natts(rel, itup,
+							   IndexRelationGetNumberOfKeyAttributes(rel));
+}
+
+/*
+ * _bt_mkscankey_pivot
+ *		As above, for a high key or internal item, which may have had
+ *		trailing attributes truncated away.  The number of scan key
+ *		entries filled in is returned in *keysz.
+ */
+ScanKey
+_bt_mkscankey_pivot(Relation rel, IndexTuple itup, int *keysz)
+{
+	*keysz = Min(BTreeTupleGetNAtts(itup, rel),
+				 IndexRelationGetNumberOfKeyAttributes(rel));
+	return _bt_mkscankey_natts(rel, itup, *keysz);
+}
+
+/*
+ * Workhorse for _bt_mkscankey and _bt_mkscankey_pivot: build scan key
+ * entries for the first natts attributes of itup.  Space is allocated for
+ * all of the index's key attributes regardless.
+ */
+static ScanKey
+_bt_mkscankey_natts(Relation rel, IndexTuple itup, int natts)
 {
 	ScanKey		skey;
 	TupleDesc	itupdesc;
-	int			natts;
 	int16	   *indoption;
 	int			i;
 
 	itupdesc = RelationGetDescr(rel);
-	natts = RelationGetNumberOfAttributes(rel);
 	indoption = rel->rd_indoption;
 
-	skey = (ScanKey) palloc(natts * sizeof(ScanKeyData));
+	skey = (ScanKey) palloc(IndexRelationGetNumberOfKeyAttributes(rel) *
+							sizeof(ScanKeyData));
 
 	for (i = 0; i < natts; i++)
 	{
@@ -119,7 +153,7 @@ _bt_mkscankey_nodata(Relation rel)
 	int16	   *indoption;
 	int			i;
 
-	natts = RelationGetNumberOfAttributes(rel);
+	natts = IndexRelationGetNumberOfKeyAttributes(rel);
 	indoption = rel->rd_indoption;
 
 	skey = (ScanKey) palloc(natts * sizeof(ScanKeyData));
@@ -654,6 +688,267 @@ _bt_restore_array_keys(IndexScanDesc scan)
 	}
 }
 
+/*
+ * _bt_preprocess_skip_key() -- Decide whether to use a skip scan
+ *
+ * An index on (a, b) is of little help for "WHERE b = 42" in an ordinary
+ * scan: with no key on "a", the key on "b" can only be used to filter
+ * tuples, and the whole index must be read.  But if "a" has few distinct
+ * values, it is much cheaper to look up each value of "a" in turn and do
+ * a search for "a = value AND b = 42" within it, hopping over everything
+ * else.  We do that when the scan has keys on the second index column but
+ * none on the first.  _bt_skip_first() finds the values of "a".
+ *
+ * Scans with array keys or row comparisons are left alone; merging those
+ * with the made-up key would gain little for the complexity.  So are
+ * parallel scans, whose participants can only move forward together.
+ *
+ * This is called at btrescan time, after _bt_preprocess_array_keys().
+ */
+void
+_bt_preprocess_skip_key(IndexScanDesc scan)
+{
+	BTScanOpaque so = (BTScanOpaque) scan->opaque;
+	Relation	rel = scan->indexRelation;
+	int			numberOfKeys = scan->numberOfKeys;
+	int			i;
+
+	/* Release any values left over from a previous scan */
+	if (so->skipScan)
+	{
+		Form_pg_attribute att = RelationGetDescr(rel)->attrs[0];
+
+		so->skipState = BT_SKIP_START;
+		_bt_set_skip_value(scan, (Datum) 0, true);
+		if (!so->markSkipIsNull && !att->attbyval)
+			pfree(DatumGetPointer(so->markSkipValue));
+		so->markSkipIsNull = true;
+		so->markSkipState = BT_SKIP_START;
+		so->markSkipGeneration = so->skipGeneration;
+	}
+	so->skipScan = false;
+
+	if (IndexRelationGetNumberOfKeyAttributes(rel) < 2 ||
+		numberOfKeys < 1 ||
+		so->numArrayKeys != 0 ||
+		scan->parallel_scan != NULL ||
+		scan->keyData[0].sk_attno != 2)
+		return;
+	for (i = 0; i < numberOfKeys; i++)
+	{
+		if (scan->keyData[i].sk_flags & SK_ROW_HEADER)
+			return;
+	}
+
+	/*
+	 * First time through, look up the leading column's "=", ">=" and "<="
+	 * operators.  Every btree opfamily has these, but be careful anyway.
+	 */
+	if (so->skipContext == NULL)
+	{
+		Oid			opfamily = rel->rd_opfamily[0];
+		Oid			opcintype = rel->rd_opcintype[0];
+		Oid			eqop;
+		Oid			geop;
+		Oid			leop;
+
+		so->skipContext = AllocSetContextCreate(CurrentMemoryContext,
+												"BTree Skip Context",
+												ALLOCSET_SMALL_MINSIZE,
+												ALLOCSET_SMALL_INITSIZE,
+												ALLOCSET_SMALL_MAXSIZE);
+		so->skipKeyData = (ScanKey)
+			MemoryContextAlloc(so->skipContext,
+							   (numberOfKeys + 1) * sizeof(ScanKeyData));
+
+		eqop = get_opfamily_member(opfamily, opcintype, opcintype,
+								   BTEqualStrategyNumber);
+		geop = get_opfamily_member(opfamily, opcintype, opcintype,
+								   BTGreaterEqualStrategyNumber);
+		leop = get_opfamily_member(opfamily, opcintype, opcintype,
+								   BTLessEqualStrategyNumber);
+		if (!OidIsValid(eqop) || !OidIsValid(geop) || !OidIsValid(leop))
+		{
+			so->skipEqFunc.fn_oid = InvalidOid;
+			return;
+		}
+		fmgr_info_cxt(get_opcode(eqop), &so->skipEqFunc, so->skipContext);
+		fmgr_info_cxt(get_opcode(geop), &so->skipGeFunc, so->skipContext);
+		fmgr_info_cxt(get_opcode(leop), &so->skipLeFunc, so->skipContext);
+	}
+	else if (!OidIsValid(so->skipEqFunc.fn_oid))
+		return;
+
+	/*
+	 * The scan keys proper follow the skip key.  _bt_preprocess_keys() will
+	 * read the whole lot, so the keys on the second column are treated just
+	 * as though the first column had an "=" key.
+	 */
+	memcpy(so->skipKeyData + 1, scan->keyData,
+		   numberOfKeys * sizeof(ScanKeyData));
+
+	so->skipScan = true;
+	so->skipState = BT_SKIP_START;
+	so->skipDir = NoMovementScanDirection;
+	so->skipIsNull = true;
+	so->skipLastBlock = InvalidBlockNumber;
+	so->skipNumWasted = 0;
+}
+
+/*
+ * _bt_set_skip_value() -- Install a new leading column value
+ *
+ * The caller must have set skipState (and skipDir, for BT_SKIP_BOUND) to
+ * go with it.  The value is copied, so it may point into an index page.
+ * Passing isnull with skipState BT_SKIP_START just releases the old value.
+ */
+void
+_bt_set_skip_value(IndexScanDesc scan, Datum value, bool isnull)
+{
+	BTScanOpaque so = (BTScanOpaque) scan->opaque;
+	Form_pg_attribute att = RelationGetDescr(scan->indexRelation)->attrs[0];
+
+	if (!so->skipIsNull && !att->attbyval)
+		pfree(DatumGetPointer(so->skipValue));
+
+	if (isnull)
+		so->skipValue = (Datum) 0;
+	else
+	{
+		MemoryContext oldcxt = MemoryContextSwitchTo(so->skipContext);
+
+		so->skipValue = datumCopy(value, att->attbyval, att->attlen);
+		MemoryContextSwitchTo(oldcxt);
+	}
+	so->skipIsNull = isnull;
+	so->skipGeneration++;
+
+	if (so->skipState != BT_SKIP_START)
+		_bt_init_skip_key(scan);
+}
+
+/*
+ * Fill in the made-up leading column key to match the current skip state.
+ *
+ * The key is set up afresh, with the strategy as seen by the user; it is
+ * _bt_preprocess_keys() that commutes it for a DESC column.
+ */
+static void
+_bt_init_skip_key(IndexScanDesc scan)
+{
+	BTScanOpaque so = (BTScanOpaque) scan->opaque;
+	Relation	rel = scan->indexRelation;
+	ScanKey		skey = &so->skipKeyData[0];
+
+	if (so->skipIsNull)
+	{
+		Assert(so->skipState == BT_SKIP_EQUAL);
+		ScanKeyEntryInitialize(skey,
+							   SK_ISNULL | SK_SEARCHNULL,
+							   1,
+							   InvalidStrategy,
+							   InvalidOid,
+							   InvalidOid,
+							   InvalidOid,
+							   (Datum) 0);
+	}
+	else if (so->skipState == BT_SKIP_EQUAL)
+		ScanKeyEntryInitializeWithInfo(skey,
+									   0,
+									   1,
+									   BTEqualStrategyNumber,
+									   rel->rd_opcintype[0],
+									   rel->rd_indcollation[0],
+									   &so->skipEqFunc,
+									   so->skipValue);
+	else
+	{
+		bool		desc = (rel->rd_indoption[0] & INDOPTION_DESC) != 0;
+
+		/* values still to come in skipDir are >= skipValue, or <= */
+		Assert(so->skipState == BT_SKIP_BOUND);
+		if (ScanDirectionIsForward(so->skipDir) != desc)
+			ScanKeyEntryInitializeWithInfo(skey,
+										   0,
+										   1,
+										   BTGreaterEqualStrategyNumber,
+										   rel->rd_opcintype[0],
+										   rel->rd_indcollation[0],
+										   &so->skipGeFunc,
+										   so->skipValue);
+		else
+			ScanKeyEntryInitializeWithInfo(skey,
+										   0,
+										   1,
+										   BTLessEqualStrategyNumber,
+										   rel->rd_opcintype[0],
+										   rel->rd_indcollation[0],
+										   &so->skipLeFunc,
+										   so->skipValue);
+	}
+}
+
+/*
+ * _bt_mark_skip_key() -- Handle a skip scan during btmarkpos
+ *
+ * Merge joins mark often, so we only copy the value when it has changed
+ * since the last mark.
+ */
+void
+_bt_mark_skip_key(IndexScanDesc scan)
+{
+	BTScanOpaque so = (BTScanOpaque) scan->opaque;
+	Form_pg_attribute att = RelationGetDescr(scan->indexRelation)->attrs[0];
+
+	so->markSkipState = so->skipState;
+	so->markSkipDir = so->skipDir;
+	if (so->markSkipGeneration == so->skipGeneration)
+		return;
+
+	if (!so->markSkipIsNull && !att->attbyval)
+		pfree(DatumGetPointer(so->markSkipValue));
+	if (so->skipIsNull)
+		so->markSkipValue = (Datum) 0;
+	else
+	{
+		MemoryContext oldcxt = MemoryContextSwitchTo(so->skipContext);
+
+		so->markSkipValue = datumCopy(so->skipValue,
+									  att->attbyval, att->attlen);
+		MemoryContextSwitchTo(oldcxt);
+	}
+	so->markSkipIsNull = so->skipIsNull;
+	so->markSkipGeneration = so->skipGeneration;
+}
+
+/*
+ * _bt_restore_skip_key() -- Handle a skip scan during btrestrpos
+ *
+ * Go back to the leading column value the mark was set with, and redo
+ * _bt_preprocess_keys() to suit, as _bt_restore_array_keys() does.
+ */
+void
+_bt_restore_skip_key(IndexScanDesc scan)
+{
+	BTScanOpaque so = (BTScanOpaque) scan->opaque;
+
+	if (so->skipState == so->markSkipState &&
+		so->skipDir == so->markSkipDir &&
+		so->skipGeneration == so->markSkipGeneration)
+		return;
+
+	so->skipState = so->markSkipState;
+	so->skipDir = so->markSkipDir;
+	_bt_set_skip_value(scan, so->markSkipValue, so->markSkipIsNull);
+	so->skipGeneration = so->markSkipGeneration;
+
+	if (so->skipState != BT_SKIP_START)
+	{
+		_bt_preprocess_keys(scan);
+		Assert(so->qual_ok);
+	}
+}
+
 
 /*
  *	_bt_preprocess_keys() -- Preprocess scan keys
@@ -764,9 +1059,16 @@ _bt_preprocess_keys(IndexScanDesc scan)
 		return;					/* done if qual-less scan */
 
 	/*
-	 * Read so->arrayKeyData if array keys are present, else scan->keyData
+	 * Read so->skipKeyData in a skip scan, so->arrayKeyData if array keys
+	 * are present, else scan->keyData
 	 */
-	if (so->arrayKeyData != NULL)
+	if (so->skipScan)
+	{
+		Assert(so->skipState != BT_SKIP_START);
+		inkeys = so->skipKeyData;
+		numberOfKeys++;
+	}
+	else if (so->arrayKeyData != NULL)
 		inkeys = so->arrayKeyData;
 	else
 		inkeys = scan->keyData;
@@ -1733,7 +2035,8 @@ _bt_check_rowcompare(ScanKey skey, IndexTuple tuple, TupleDesc tupdesc,
  * delete.  We cope with cases where items have moved right due to insertions.
  * If an item has moved off the current page due to a split, we'll fail to
  * find it and do nothing (this is not an error case --- we assume the item
- * will eventually get marked in a future indexscan).
+ * will eventually get marked in a future indexscan).  A posting list tuple
+ * is marked only if every one of its heap TIDs was reported killed.
  *
  * Note that if we hold a pin on the target page continuously from initially
  * reading the items until applying this function, VACUUM cannot have deleted
@@ -1821,7 +2124,21 @@ _bt_killitems(IndexScanDesc scan)
 			ItemId		iid = PageGetItemId(page, offnum);
 			IndexTuple	ituple = (IndexTuple) PageGetItem(page, iid);
 
-			if (ItemPointerEquals(&ituple->t_tid, &kitem->heapTid))
+			if (BTreeTupleIsPosting(ituple))
+			{
+				if (_bt_posting_contains(ituple, &kitem->heapTid))
+				{
+					/* found the item, but can we kill all of it? */
+					if (!ItemIdIsDead(iid) &&
+						_bt_posting_all_killed(so, numKilled, ituple))
+					{
+						ItemIdMarkDead(iid);
+						killedsomething = true;
+					}
+					break;		/* out of inner search loop */
+				}
+			}
+			else if (ItemPointerEquals(&ituple->t_tid, &kitem->heapTid))
 			{
 				/* found the item */
 				ItemIdMarkDead(iid);
@@ -1847,6 +2164,118 @@ _bt_killitems(IndexScanDesc scan)
 	LockBuffer(so->currPos.buf, BUFFER_LOCK_UNLOCK);
 }
 
+/*
+ * _bt_truncate() -- build the pivot tuple separating two leaf items.
+ *
+ * lastleft and firstright are the last item that stays on the left half and
+ * the first item going to the right half of a leaf page split.  The result
+ * is a palloc'd copy of firstright's key, cut down to the attributes up to
+ * and including the first one on which the two items differ, as decided by
+ * the opclass comparison procs.  If they're equal on every attribute nothing
+ * can be cut, but any posting list is still left out.  Non-key INCLUDE
+ * columns are never needed to separate anything, so they are always cut.
+ *
+ * The result is suitable as the left page's new high key and, with its
+ * downlink set, as the right page's entry in the parent.
+ */
+IndexTuple
+_bt_truncate(Relation rel, IndexTuple lastleft, IndexTuple firstright)
+{
+	TupleDesc	itupdesc = RelationGetDescr(rel);
+	int			natts = RelationGetNumberOfAttributes(rel);
+	int			nkeyatts = IndexRelationGetNumberOfKeyAttributes(rel);
+	ScanKey		skey;
+	int			keepnatts;
+	TupleDesc	pivotdesc;
+	Datum		values[INDEX_MAX_KEYS];
+	bool		isnull[INDEX_MAX_KEYS];
+	IndexTuple	pivot;
+
+	skey = _bt_mkscankey(rel, firstright);
+	for (keepnatts = 1; keepnatts <= nkeyatts; keepnatts++)
+	{
+		ScanKey		key = &skey[keepnatts - 1];
+		Datum		datum;
+		bool		isNull;
+
+		datum = index_getattr(lastleft, keepnatts, itupdesc, &isNull);
+
+		if (isNull || (key->sk_flags & SK_ISNULL))
+		{
+			if (isNull && (key->sk_flags & SK_ISNULL))
+				continue;
+			break;
+		}
+		if (DatumGetInt32(FunctionCall2Coll(&key->sk_func,
+											key->sk_collation,
+											datum,
+											key->sk_argument)) != 0)
+			break;
+	}
+	_bt_freeskey(skey);
+
+	/* keys equal on every attribute must all be kept */
+	keepnatts = Min(keepnatts, nkeyatts);
+	if (keepnatts >= natts)
+		return _bt_key_copy(firstright);
+
+	/* form a tuple from the leading attributes only */
+	index_deform_tuple(firstright, itupdesc, values, isnull);
+	pivotdesc = CreateTupleDescCopy(itupdesc);
+	pivotdesc->natts = keepnatts;
+	pivot = index_form_tuple(pivotdesc, values, isnull);
+	FreeTupleDesc(pivotdesc);
+
+	pivot->t_info |= BT_IS_TRUNCATED;
+	ItemPointerSet(&pivot->t_tid, P_NONE, keepnatts);
+
+	return pivot;
+}
+
+/*
+ * Does the posting list of itup include htid?
+ */
+static bool
+_bt_posting_contains(IndexTuple itup, ItemPointer htid)
+{
+	int			nposting = BTreeTupleGetNPosting(itup);
+	int			i;
+
+	for (i = 0; i < nposting; i++)
+	{
+		if (ItemPointerEquals(BTreeTupleGetPostingN(itup, i), htid))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Were all the heap TIDs in itup's posting list reported killed by the scan?
+ */
+static bool
+_bt_posting_all_killed(BTScanOpaque so, int numKilled, IndexTuple itup)
+{
+	int			nposting = BTreeTupleGetNPosting(itup);
+	int			i,
+				j;
+
+	for (i = 0; i < nposting; i++)
+	{
+		ItemPointer htid = BTreeTupleGetPostingN(itup, i);
+
+		for (j = 0; j < numKilled; j++)
+		{
+			BTScanPosItem *kitem = &so->currPos.items[so->killedItems[j]];
+
+			if (ItemPointerEquals(&kitem->heapTid, htid))
+				break;
+		}
+		if (j >= numKilled)
+			return false;
+	}
+	return true;
+}
+
 
 /*
  * The following routines manage a shared-memory area in which we track
@@ -32,6 +32,13 @@ dbase_desc(StringInfo buf, XLogReaderState *record)
 						 xlrec->src_db_id, xlrec->src_tablespace_id,
 						 xlrec->db_id, xlrec->tablespace_id);
 	}
+	else if (info == XLOG_DBASE_CREATE_WAL_LOG)
+	{
+		xl_dbase_create_wal_log_rec *xlrec = (xl_dbase_create_wal_log_rec *) rec;
+
+		appendStringInfo(buf, "create dir %u/%u",
+						 xlrec->db_id, xlrec->tablespace_id);
+	}
 	else if (info == XLOG_DBASE_DROP)
 	{
 		xl_dbase_drop_rec *xlrec = (xl_dbase_drop_rec *) rec;
@@ -51,6 +58,9 @@ dbase_identify(uint8 info)
 		case XLOG_DBASE_CREATE:
 			id = "CREATE";
 			break;
+		case XLOG_DBASE_CREATE_WAL_LOG:
+			id = "CREATE_WAL_LOG";
+			break;
 		case XLOG_DBASE_DROP:
 			id = "DROP";
 			break;
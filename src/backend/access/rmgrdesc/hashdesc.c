@@ -1,7 +1,7 @@
 /*-------------------------------------------------------------------------
  *
  * hashdesc.c
- *	  rmgr descriptor routines for access/hash/hash.c
+ *	  rmgr descriptor routines for access/hash/hashxlog.c
  *
  * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
  * Portions Copyright (c) 1994, Regents of the University of California
@@ -19,10 +19,94 @@
 void
 hash_desc(StringInfo buf, XLogReaderState *record)
 {
+	char	   *rec = XLogRecGetData(record);
+	uint8		info = XLogRecGetInfo(record) & ~XLR_INFO_MASK;
+
+	switch (info)
+	{
+		case XLOG_HASH_INSERT:
+			{
+				xl_hash_insert *xlrec = (xl_hash_insert *) rec;
+
+				appendStringInfo(buf, "off %u", xlrec->offnum);
+				break;
+			}
+		case XLOG_HASH_SPLIT_COPY:
+			{
+				xl_hash_split_copy *xlrec = (xl_hash_split_copy *) rec;
+
+				appendStringInfo(buf, "ntups %u", xlrec->ntups);
+				break;
+			}
+		case XLOG_HASH_SPLIT_STATE:
+			{
+				xl_hash_split_state *xlrec = (xl_hash_split_state *) rec;
+
+				appendStringInfo(buf, "splitstate %u", xlrec->splitstate);
+				break;
+			}
+		case XLOG_HASH_MOVE_PAGE_CONTENTS:
+			{
+				xl_hash_move_page_contents *xlrec = (xl_hash_move_page_contents *) rec;
+
+				appendStringInfo(buf, "ntups %u; is_primary %c",
+								 xlrec->ntups,
+								 xlrec->is_prim_bucket_same_wrt ? 'T' : 'F');
+				break;
+			}
+		case XLOG_HASH_DELETE:
+			{
+				xl_hash_delete *xlrec = (xl_hash_delete *) rec;
+
+				appendStringInfo(buf, "is_primary %c",
+								 xlrec->is_primary_bucket_page ? 'T' : 'F');
+				break;
+			}
+		case XLOG_HASH_UPDATE_META_PAGE:
+			{
+				xl_hash_update_meta_page *xlrec = (xl_hash_update_meta_page *) rec;
+
+				appendStringInfo(buf, "ntuples %g", xlrec->ntuples);
+				break;
+			}
+	}
 }
 
 const char *
 hash_identify(uint8 info)
 {
-	return NULL;
+	const char *id = NULL;
+
+	switch (info & ~XLR_INFO_MASK)
+	{
+		case XLOG_HASH_INSERT:
+			id = "INSERT";
+			break;
+		case XLOG_HASH_ADD_OVFL_PAGE:
+			id = "ADD_OVFL_PAGE";
+			break;
+		case XLOG_HASH_FREE_OVFL_PAGE:
+			id = "FREE_OVFL_PAGE";
+			break;
+		case XLOG_HASH_SPLIT_ALLOCATE:
+			id = "SPLIT_ALLOCATE";
+			break;
+		case XLOG_HASH_SPLIT_COPY:
+			id = "SPLIT_COPY";
+			break;
+		case XLOG_HASH_SPLIT_STATE:
+			id = "SPLIT_STATE";
+			break;
+		case XLOG_HASH_MOVE_PAGE_CONTENTS:
+			id = "MOVE_PAGE_CONTENTS";
+			break;
+		case XLOG_HASH_DELETE:
+			id = "DELETE";
+			break;
+		case XLOG_HASH_UPDATE_META_PAGE:
+			id = "UPDATE_META_PAGE";
+			break;
+	}
+
+	return id;
 }
@@ -15,7 +15,7 @@
 
 #include "postgres.h"
 
-#include "access/spgist.h"
+#include "access/spgist_private.h"
 #include "access/stratnum.h"
 #include "catalog/pg_type.h"
 #include "utils/builtins.h"
@@ -162,6 +162,8 @@ spg_kd_inner_consistent(PG_FUNCTION_ARGS)
 	double		coord;
 	int			which;
 	int			i;
+	BOX			infbbox;
+	BOX		   *bbox = NULL;
 
 	Assert(in->hasPrefix);
 	coord = DatumGetFloat8(in->prefixDatum);
@@ -248,12 +250,73 @@ spg_kd_inner_consistent(PG_FUNCTION_ARGS)
 	}
 
 	/* We must descend into the children identified by which */
-	out->nodeNumbers = (int *) palloc(sizeof(int) * 2);
 	out->nNodes = 0;
+
+	out->nodeNumbers = (int *) palloc(sizeof(int) * 2);
+
+	/*
+	 * An ordered scan needs the bounding box of each child to compute the
+	 * distance to it.  We pass them down as traversal values; the root's
+	 * box is the whole plane.
+	 */
+	if (in->norderbys > 0)
+	{
+		out->distances = (double **) palloc(sizeof(double *) * 2);
+		out->traversalValues = (void **) palloc(sizeof(void *) * 2);
+
+		if (in->traversalValue)
+			bbox = (BOX *) in->traversalValue;
+		else
+		{
+			double		inf = get_float8_infinity();
+
+			infbbox.high.x = inf;
+			infbbox.high.y = inf;
+			infbbox.low.x = -inf;
+			infbbox.low.y = -inf;
+			bbox = &infbbox;
+		}
+	}
+
 	for (i = 1; i <= 2; i++)
 	{
 		if (which & (1 << i))
-			out->nodeNumbers[out->nNodes++] = i - 1;
+		{
+			out->nodeNumbers[out->nNodes] = i - 1;
+
+			if (in->norderbys > 0)
+			{
+				MemoryContext oldCtx;
+				BOX		   *area;
+
+				oldCtx = MemoryContextSwitchTo(in->traversalMemoryContext);
+				area = box_copy(bbox);
+				MemoryContextSwitchTo(oldCtx);
+
+				/* child 0 holds the points below coord, child 1 the rest */
+				if ((in->level % 2) != 0)
+				{
+					if (i == 1)
+						area->high.x = coord;
+					else
+						area->low.x = coord;
+				}
+				else
+				{
+					if (i == 1)
+						area->high.y = coord;
+					else
+						area->low.y = coord;
+				}
+
+				out->traversalValues[out->nNodes] = area;
+				out->distances[out->nNodes] =
+					spg_key_orderbys_distances(BoxPGetDatum(area), false,
+											   in->orderbys, in->norderbys);
+			}
+
+			out->nNodes++;
+		}
 	}
 
 	/* Set up level increments, too */
@@ -17,74 +17,161 @@
 
 #include "access/relscan.h"
 #include "access/spgist_private.h"
+#include "catalog/pg_type.h"
 #include "miscadmin.h"
 #include "storage/bufmgr.h"
+#include "utils/builtins.h"
 #include "utils/datum.h"
+#include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
 
 
 typedef void (*storeRes_func) (SpGistScanOpaque so, ItemPointer heapPtr,
-								 Datum leafValue, bool isnull, bool recheck);
+								 Datum leafValue, bool isnull, bool recheck,
+								 bool recheckDistances, double *distances);
 
-typedef struct ScanStackEntry
+/*
+ * Pairing heap comparison function for the SpGistSearchItem queue of an
+ * ordered scan.  Smaller distances come first; on ties, heap tuples go
+ * before pages, so that a tuple is returned as soon as nothing closer can
+ * turn up.
+ */
+static int
+pairingheap_SpGistSearchItem_cmp(const pairingheap_node *a,
+								 const pairingheap_node *b, void *arg)
 {
-	Datum		reconstructedValue;		/* value reconstructed from parent */
-	int			level;			/* level of items on this page */
-	ItemPointerData ptr;		/* block and offset to scan from */
-} ScanStackEntry;
+	const SpGistSearchItem *sa = (const SpGistSearchItem *) a;
+	const SpGistSearchItem *sb = (const SpGistSearchItem *) b;
+	SpGistScanOpaque so = (SpGistScanOpaque) arg;
+	int			i;
+
+	for (i = 0; i < so->numberOfOrderBys; i++)
+	{
+		if (sa->distances[i] != sb->distances[i])
+			return (sa->distances[i] < sb->distances[i]) ? 1 : -1;
+	}
+
+	/* Heap items go before inner pages, to ensure a depth-first search */
+	if (sa->isLeaf && !sb->isLeaf)
+		return 1;
+	if (!sa->isLeaf && sb->isLeaf)
+		return -1;
 
+	return 0;
+}
+
+/* Allocate a search item, with room for the distances, in traversalCxt */
+static SpGistSearchItem *
+spgAllocSearchItem(SpGistScanOpaque so)
+{
+	return (SpGistSearchItem *)
+		MemoryContextAllocZero(so->traversalCxt,
+							   SizeOfSpGistSearchItem(so->numberOfOrderBys));
+}
 
-/* Free a ScanStackEntry */
+/* Free a SpGistSearchItem */
 static void
-freeScanStackEntry(SpGistScanOpaque so, ScanStackEntry *stackEntry)
+spgFreeSearchItem(SpGistScanOpaque so, SpGistSearchItem *item)
 {
 	if (!so->state.attType.attbyval &&
-		DatumGetPointer(stackEntry->reconstructedValue) != NULL)
-		pfree(DatumGetPointer(stackEntry->reconstructedValue));
-	pfree(stackEntry);
+		DatumGetPointer(item->value) != NULL)
+		pfree(DatumGetPointer(item->value));
+	if (item->traversalValue)
+		pfree(item->traversalValue);
+	pfree(item);
 }
 
-/* Free the entire stack */
+/*
+ * Add a work item to the stack or, in an ordered scan, to the queue.
+ * The caller has filled in its distances, if any.
+ */
 static void
-freeScanStack(SpGistScanOpaque so)
+spgAddSearchItem(SpGistScanOpaque so, SpGistSearchItem *item)
 {
-	ListCell   *lc;
+	if (so->numberOfOrderBys > 0)
+		pairingheap_add(so->scanQueue, &item->phNode);
+	else
+		so->scanStack = lcons(item, so->scanStack);
+}
+
+/* Pull the next work item from the stack or queue, or NULL if none left */
+static SpGistSearchItem *
+spgGetNextSearchItem(SpGistScanOpaque so)
+{
+	SpGistSearchItem *item;
 
-	foreach(lc, so->scanStack)
+	if (so->numberOfOrderBys > 0)
 	{
-		freeScanStackEntry(so, (ScanStackEntry *) lfirst(lc));
+		if (pairingheap_is_empty(so->scanQueue))
+			return NULL;
+		return (SpGistSearchItem *) pairingheap_remove_first(so->scanQueue);
 	}
-	list_free(so->scanStack);
-	so->scanStack = NIL;
+
+	if (so->scanStack == NIL)
+		return NULL;
+	item = (SpGistSearchItem *) linitial(so->scanStack);
+	so->scanStack = list_delete_first(so->scanStack);
+	return item;
+}
+
+/* Set up a work item to scan the null or non-null part of the index */
+static void
+spgAddStartItem(SpGistScanOpaque so, bool isnull)
+{
+	SpGistSearchItem *startEntry = spgAllocSearchItem(so);
+
+	ItemPointerSet(&startEntry->heapPtr,
+				   isnull ? SPGIST_NULL_BLKNO : SPGIST_ROOT_BLKNO,
+				   FirstOffsetNumber);
+	startEntry->isNull = isnull;
+
+	if (so->numberOfOrderBys > 0)
+	{
+		/* NULLs have no distance; make them come last */
+		memcpy(startEntry->distances,
+			   isnull ? so->infDistances : so->zeroDistances,
+			   sizeof(double) * so->numberOfOrderBys);
+		pairingheap_add(so->scanQueue, &startEntry->phNode);
+	}
+	else
+		so->scanStack = lappend(so->scanStack, startEntry);
 }
 
 /*
- * Initialize scanStack to search the root page, resetting
+ * Initialize the stack or queue to search the root page, resetting
  * any previously active scan
  */
 static void
 resetSpGistScanOpaque(SpGistScanOpaque so)
 {
-	ScanStackEntry *startEntry;
-
-	freeScanStack(so);
+	/* all the work items and traversal values live in traversalCxt */
+	list_free(so->scanStack);
+	so->scanStack = NIL;
+	MemoryContextReset(so->traversalCxt);
 
-	if (so->searchNulls)
+	if (so->numberOfOrderBys > 0)
 	{
-		/* Stack a work item to scan the null index entries */
-		startEntry = (ScanStackEntry *) palloc0(sizeof(ScanStackEntry));
-		ItemPointerSet(&startEntry->ptr, SPGIST_NULL_BLKNO, FirstOffsetNumber);
-		so->scanStack = lappend(so->scanStack, startEntry);
+		int			i;
+
+		MemoryContext oldCtx = MemoryContextSwitchTo(so->traversalCxt);
+
+		so->scanQueue = pairingheap_allocate(pairingheap_SpGistSearchItem_cmp,
+											 so);
+		MemoryContextSwitchTo(oldCtx);
+
+		for (i = 0; i < so->numberOfOrderBys; i++)
+		{
+			so->zeroDistances[i] = 0.0;
+			so->infDistances[i] = get_float8_infinity();
+		}
 	}
 
+	if (so->searchNulls)
+		spgAddStartItem(so, true);
+
 	if (so->searchNonNulls)
-	{
-		/* Stack a work item to scan the non-null index entries */
-		startEntry = (ScanStackEntry *) palloc0(sizeof(ScanStackEntry));
-		ItemPointerSet(&startEntry->ptr, SPGIST_ROOT_BLKNO, FirstOffsetNumber);
-		so->scanStack = lappend(so->scanStack, startEntry);
-	}
+		spgAddStartItem(so, false);
 
 	if (so->want_itup)
 	{
@@ -178,12 +265,12 @@ spgbeginscan(PG_FUNCTION_ARGS)
 {
 	Relation	rel = (Relation) PG_GETARG_POINTER(0);
 	int			keysz = PG_GETARG_INT32(1);
-
-	/* ScanKey			scankey = (ScanKey) PG_GETARG_POINTER(2); */
+	int			orderbysz = PG_GETARG_INT32(2);
 	IndexScanDesc scan;
 	SpGistScanOpaque so;
+	int			i;
 
-	scan = RelationGetIndexScan(rel, keysz, 0);
+	scan = RelationGetIndexScan(rel, keysz, orderbysz);
 
 	so = (SpGistScanOpaque) palloc0(sizeof(SpGistScanOpaqueData));
 	if (keysz > 0)
@@ -196,6 +283,32 @@ spgbeginscan(PG_FUNCTION_ARGS)
 										ALLOCSET_DEFAULT_MINSIZE,
 										ALLOCSET_DEFAULT_INITSIZE,
 										ALLOCSET_DEFAULT_MAXSIZE);
+	so->traversalCxt = AllocSetContextCreate(CurrentMemoryContext,
+											 "SP-GiST traversal-value context",
+											 ALLOCSET_DEFAULT_MINSIZE,
+											 ALLOCSET_DEFAULT_INITSIZE,
+											 ALLOCSET_DEFAULT_MAXSIZE);
+
+	/*
+	 * For an ordered scan, set up the distance workspace, and remember the
+	 * result type of each ordering operator so that we can return the
+	 * distances in that type.
+	 */
+	so->numberOfOrderBys = orderbysz;
+	so->orderByData = scan->orderByData;
+	if (orderbysz > 0)
+	{
+		so->zeroDistances = (double *) palloc(sizeof(double) * orderbysz);
+		so->infDistances = (double *) palloc(sizeof(double) * orderbysz);
+		so->distances = (double *) palloc(sizeof(double) * orderbysz);
+		so->orderByTypes = (Oid *) palloc(sizeof(Oid) * orderbysz);
+		for (i = 0; i < orderbysz; i++)
+			so->orderByTypes[i] = InvalidOid;	/* filled in by spgrescan */
+
+		scan->xs_orderbyvals = (Datum *) palloc0(sizeof(Datum) * orderbysz);
+		scan->xs_orderbynulls = (bool *) palloc(sizeof(bool) * orderbysz);
+		memset(scan->xs_orderbynulls, true, sizeof(bool) * orderbysz);
+	}
 
 	/* Set up indexTupDesc and xs_itupdesc in case it's an index-only scan */
 	so->indexTupDesc = scan->xs_itupdesc = RelationGetDescr(rel);
@@ -211,6 +324,7 @@ spgrescan(PG_FUNCTION_ARGS)
 	IndexScanDesc scan = (IndexScanDesc) PG_GETARG_POINTER(0);
 	SpGistScanOpaque so = (SpGistScanOpaque) scan->opaque;
 	ScanKey		scankey = (ScanKey) PG_GETARG_POINTER(1);
+	ScanKey		orderbys = (ScanKey) PG_GETARG_POINTER(3);
 
 	/* copy scankeys into local storage */
 	if (scankey && scan->numberOfKeys > 0)
@@ -219,6 +333,19 @@ spgrescan(PG_FUNCTION_ARGS)
 				scan->numberOfKeys * sizeof(ScanKeyData));
 	}
 
+	/* copy ordering operators, too */
+	if (orderbys && scan->numberOfOrderBys > 0)
+	{
+		int			i;
+
+		memmove(scan->orderByData, orderbys,
+				scan->numberOfOrderBys * sizeof(ScanKeyData));
+
+		for (i = 0; i < scan->numberOfOrderBys; i++)
+			so->orderByTypes[i] =
+				get_func_rettype(scan->orderByData[i].sk_func.fn_oid);
+	}
+
 	/* preprocess scankeys, set up the representation in *so */
 	spgPrepareScanKeys(scan);
 
@@ -235,6 +362,7 @@ spgendscan(PG_FUNCTION_ARGS)
 	SpGistScanOpaque so = (SpGistScanOpaque) scan->opaque;
 
 	MemoryContextDelete(so->tempCxt);
+	MemoryContextDelete(so->traversalCxt);
 
 	PG_RETURN_VOID();
 }
@@ -258,12 +386,16 @@ spgrestrpos(PG_FUNCTION_ARGS)
  *
  * *leafValue is set to the reconstructed datum, if provided
  * *recheck is set true if any of the operators are lossy
+ * In an ordered scan, *distances is set to the distances to the ordering
+ * operators' arguments (in tempCxt), and *recheckDistances to true if they
+ * are inexact
  */
 static bool
 spgLeafTest(Relation index, SpGistScanOpaque so,
 			SpGistLeafTuple leafTuple, bool isnull,
-			int level, Datum reconstructedValue,
-			Datum *leafValue, bool *recheck)
+			SpGistSearchItem *item,
+			Datum *leafValue, bool *recheck,
+			double **distances, bool *recheckDistances)
 {
 	bool		result;
 	Datum		leafDatum;
@@ -278,6 +410,8 @@ spgLeafTest(Relation index, SpGistScanOpaque so,
 		Assert(so->searchNulls);
 		*leafValue = (Datum) 0;
 		*recheck = false;
+		*distances = so->infDistances;
+		*recheckDistances = false;
 		return true;
 	}
 
@@ -288,13 +422,18 @@ spgLeafTest(Relation index, SpGistScanOpaque so,
 
 	in.scankeys = so->keyData;
 	in.nkeys = so->numberOfKeys;
-	in.reconstructedValue = reconstructedValue;
-	in.level = level;
+	in.orderbys = so->orderByData;
+	in.norderbys = so->numberOfOrderBys;
+	in.reconstructedValue = item->value;
+	in.traversalValue = item->traversalValue;
+	in.level = item->level;
 	in.returnData = so->want_itup;
 	in.leafDatum = leafDatum;
 
 	out.leafValue = (Datum) 0;
 	out.recheck = false;
+	out.recheckDistances = false;
+	out.distances = NULL;
 
 	procinfo = index_getprocinfo(index, 1, SPGIST_LEAF_CONSISTENT_PROC);
 	result = DatumGetBool(FunctionCall2Coll(procinfo,
@@ -304,18 +443,75 @@ spgLeafTest(Relation index, SpGistScanOpaque so,
 
 	*leafValue = out.leafValue;
 	*recheck = out.recheck;
+	*distances = out.distances;
+	*recheckDistances = out.recheckDistances;
+
+	if (result && so->numberOfOrderBys > 0 && out.distances == NULL)
+		elog(ERROR, "SP-GiST leaf_consistent function did not compute distances for ordered scan");
 
 	MemoryContextSwitchTo(oldCtx);
 
 	return result;
 }
 
+/*
+ * Handle a leaf tuple that passed spgLeafTest.  In an unordered scan it's
+ * reported right away.  In an ordered scan, it's queued up with its
+ * distances instead, to be reported when it reaches the front of the queue.
+ * Returns true if the tuple was reported.
+ */
+static bool
+spgReportLeafTuple(SpGistScanOpaque so, SpGistLeafTuple leafTuple,
+				   bool isnull, Datum leafValue, bool recheck,
+				   double *distances, bool recheckDistances,
+				   storeRes_func storeRes)
+{
+	SpGistSearchItem *heapItem;
+
+	Assert(ItemPointerIsValid(&leafTuple->heapPtr));
+
+	if (so->numberOfOrderBys == 0)
+	{
+		storeRes(so, &leafTuple->heapPtr, leafValue, isnull, recheck,
+				 false, NULL);
+		return true;
+	}
+
+	heapItem = spgAllocSearchItem(so);
+	heapItem->heapPtr = leafTuple->heapPtr;
+	heapItem->isLeaf = true;
+	heapItem->isNull = isnull;
+	heapItem->recheck = recheck;
+	heapItem->recheckDistances = recheckDistances;
+	memcpy(heapItem->distances, distances,
+		   sizeof(double) * so->numberOfOrderBys);
+
+	/* the leaf value is in the page or in tempCxt, so copy it */
+	if (so->want_itup && !isnull)
+	{
+		MemoryContext oldCtx = MemoryContextSwitchTo(so->traversalCxt);
+
+		heapItem->value = datumCopy(leafValue,
+									so->state.attType.attbyval,
+									so->state.attType.attlen);
+		MemoryContextSwitchTo(oldCtx);
+	}
+	else
+		heapItem->value = (Datum) 0;
+
+	spgAddSearchItem(so, heapItem);
+	return false;
+}
+
 /*
  * Walk the tree and report all tuples passing the scan quals to the storeRes
  * subroutine.
  *
  * If scanWholeIndex is true, we'll do just that.  If not, we'll stop at the
- * next page boundary once we have reported at least one tuple.
+ * next page boundary once we have reported at least one tuple.  In an ordered
+ * scan, matching heap tuples are put in the queue along with the pages, and
+ * we only report one when it comes out of the queue, so then we stop after
+ * every tuple.
  */
 static void
 spgWalk(Relation index, SpGistScanOpaque so, bool scanWholeIndex,
@@ -326,25 +522,33 @@ spgWalk(Relation index, SpGistScanOpaque so, bool scanWholeIndex,
 
 	while (scanWholeIndex || !reportedSome)
 	{
-		ScanStackEntry *stackEntry;
+		SpGistSearchItem *item;
 		BlockNumber blkno;
 		OffsetNumber offset;
 		Page		page;
 		bool		isnull;
 
-		/* Pull next to-do item from the list */
-		if (so->scanStack == NIL)
+		/* Pull next to-do item from the stack or queue */
+		item = spgGetNextSearchItem(so);
+		if (item == NULL)
 			break;				/* there are no more pages to scan */
 
-		stackEntry = (ScanStackEntry *) linitial(so->scanStack);
-		so->scanStack = list_delete_first(so->scanStack);
+		if (item->isLeaf)
+		{
+			/* a heap tuple of an ordered scan, and the closest one left */
+			Assert(so->numberOfOrderBys > 0);
+			storeRes(so, &item->heapPtr, item->value, item->isNull,
+					 item->recheck, item->recheckDistances, item->distances);
+			reportedSome = true;
+			goto done;
+		}
 
 redirect:
 		/* Check for interrupts, just in case of infinite loop */
 		CHECK_FOR_INTERRUPTS();
 
-		blkno = ItemPointerGetBlockNumber(&stackEntry->ptr);
-		offset = ItemPointerGetOffsetNumber(&stackEntry->ptr);
+		blkno = ItemPointerGetBlockNumber(&item->heapPtr);
+		offset = ItemPointerGetOffsetNumber(&item->heapPtr);
 
 		if (buffer == InvalidBuffer)
 		{
@@ -369,6 +573,8 @@ redirect:
 			OffsetNumber max = PageGetMaxOffsetNumber(page);
 			Datum		leafValue = (Datum) 0;
 			bool		recheck = false;
+			double	   *distances = NULL;
+			bool		recheckDistances = false;
 
 			if (SpGistBlockIsRoot(blkno))
 			{
@@ -387,14 +593,17 @@ redirect:
 					Assert(ItemPointerIsValid(&leafTuple->heapPtr));
 					if (spgLeafTest(index, so,
 									leafTuple, isnull,
-									stackEntry->level,
-									stackEntry->reconstructedValue,
+									item,
 									&leafValue,
-									&recheck))
+									&recheck,
+									&distances,
+									&recheckDistances))
 					{
-						storeRes(so, &leafTuple->heapPtr,
-								 leafValue, isnull, recheck);
-						reportedSome = true;
+						if (spgReportLeafTuple(so, leafTuple, isnull,
+											   leafValue, recheck,
+											   distances, recheckDistances,
+											   storeRes))
+							reportedSome = true;
 					}
 				}
 			}
@@ -411,16 +620,16 @@ redirect:
 						if (leafTuple->tupstate == SPGIST_REDIRECT)
 						{
 							/* redirection tuple should be first in chain */
-							Assert(offset == ItemPointerGetOffsetNumber(&stackEntry->ptr));
+							Assert(offset == ItemPointerGetOffsetNumber(&item->heapPtr));
 							/* transfer attention to redirect point */
-							stackEntry->ptr = ((SpGistDeadTuple) leafTuple)->pointer;
-							Assert(ItemPointerGetBlockNumber(&stackEntry->ptr) != SPGIST_METAPAGE_BLKNO);
+							item->heapPtr = ((SpGistDeadTuple) leafTuple)->pointer;
+							Assert(ItemPointerGetBlockNumber(&item->heapPtr) != SPGIST_METAPAGE_BLKNO);
 							goto redirect;
 						}
 						if (leafTuple->tupstate == SPGIST_DEAD)
 						{
 							/* dead tuple should be first in chain */
-							Assert(offset == ItemPointerGetOffsetNumber(&stackEntry->ptr));
+							Assert(offset == ItemPointerGetOffsetNumber(&item->heapPtr));
 							/* No live entries on this page */
 							Assert(leafTuple->nextOffset == InvalidOffsetNumber);
 							break;
@@ -433,14 +642,17 @@ redirect:
 					Assert(ItemPointerIsValid(&leafTuple->heapPtr));
 					if (spgLeafTest(index, so,
 									leafTuple, isnull,
-									stackEntry->level,
-									stackEntry->reconstructedValue,
+									item,
 									&leafValue,
-									&recheck))
+									&recheck,
+									&distances,
+									&recheckDistances))
 					{
-						storeRes(so, &leafTuple->heapPtr,
-								 leafValue, isnull, recheck);
-						reportedSome = true;
+						if (spgReportLeafTuple(so, leafTuple, isnull,
+											   leafValue, recheck,
+											   distances, recheckDistances,
+											   storeRes))
+							reportedSome = true;
 					}
 
 					offset = leafTuple->nextOffset;
@@ -466,8 +678,8 @@ redirect:
 				if (innerTuple->tupstate == SPGIST_REDIRECT)
 				{
 					/* transfer attention to redirect point */
-					stackEntry->ptr = ((SpGistDeadTuple) innerTuple)->pointer;
-					Assert(ItemPointerGetBlockNumber(&stackEntry->ptr) != SPGIST_METAPAGE_BLKNO);
+					item->heapPtr = ((SpGistDeadTuple) innerTuple)->pointer;
+					Assert(ItemPointerGetBlockNumber(&item->heapPtr) != SPGIST_METAPAGE_BLKNO);
 					goto redirect;
 				}
 				elog(ERROR, "unexpected SPGiST tuple state: %d",
@@ -479,8 +691,12 @@ redirect:
 
 			in.scankeys = so->keyData;
 			in.nkeys = so->numberOfKeys;
-			in.reconstructedValue = stackEntry->reconstructedValue;
-			in.level = stackEntry->level;
+			in.orderbys = so->orderByData;
+			in.norderbys = so->numberOfOrderBys;
+			in.reconstructedValue = item->value;
+			in.traversalValue = item->traversalValue;
+			in.traversalMemoryContext = so->traversalCxt;
+			in.level = item->level;
 			in.returnData = so->want_itup;
 			in.allTheSame = innerTuple->allTheSame;
 			in.hasPrefix = (innerTuple->prefixSize > 0);
@@ -522,6 +738,10 @@ redirect:
 				if (out.nNodes != 0 && out.nNodes != in.nNodes)
 					elog(ERROR, "inconsistent inner_consistent results for allTheSame inner tuple");
 
+			if (!isnull && out.nNodes > 0 && so->numberOfOrderBys > 0 &&
+				out.distances == NULL)
+				elog(ERROR, "SP-GiST inner_consistent function did not compute distances for ordered scan");
+
 			for (i = 0; i < out.nNodes; i++)
 			{
 				int			nodeN = out.nodeNumbers[i];
@@ -529,31 +749,59 @@ redirect:
 				Assert(nodeN >= 0 && nodeN < in.nNodes);
 				if (ItemPointerIsValid(&nodes[nodeN]->t_tid))
 				{
-					ScanStackEntry *newEntry;
+					SpGistSearchItem *newEntry;
 
 					/* Create new work item for this node */
-					newEntry = palloc(sizeof(ScanStackEntry));
-					newEntry->ptr = nodes[nodeN]->t_tid;
+					newEntry = spgAllocSearchItem(so);
+					newEntry->heapPtr = nodes[nodeN]->t_tid;
+					newEntry->isNull = isnull;
 					if (out.levelAdds)
-						newEntry->level = stackEntry->level + out.levelAdds[i];
+						newEntry->level = item->level + out.levelAdds[i];
 					else
-						newEntry->level = stackEntry->level;
+						newEntry->level = item->level;
 					/* Must copy value out of temp context */
 					if (out.reconstructedValues)
-						newEntry->reconstructedValue =
+					{
+						oldCtx = MemoryContextSwitchTo(so->traversalCxt);
+						newEntry->value =
 							datumCopy(out.reconstructedValues[i],
 									  so->state.attType.attbyval,
 									  so->state.attType.attlen);
+						MemoryContextSwitchTo(oldCtx);
+					}
 					else
-						newEntry->reconstructedValue = (Datum) 0;
+						newEntry->value = (Datum) 0;
+					/* traversal values are already in traversalCxt */
+					if (out.traversalValues)
+					{
+						newEntry->traversalValue = out.traversalValues[i];
+						out.traversalValues[i] = NULL;
+					}
+					else
+						newEntry->traversalValue = NULL;
+					if (so->numberOfOrderBys > 0)
+						memcpy(newEntry->distances,
+							   isnull ? so->infDistances : out.distances[i],
+							   sizeof(double) * so->numberOfOrderBys);
 
-					so->scanStack = lcons(newEntry, so->scanStack);
+					spgAddSearchItem(so, newEntry);
+				}
+			}
+
+			/* free the traversal values of nodes we aren't going to visit */
+			if (out.traversalValues)
+			{
+				for (i = 0; i < out.nNodes; i++)
+				{
+					if (out.traversalValues[i])
+						pfree(out.traversalValues[i]);
 				}
 			}
 		}
 
-		/* done with this scan stack entry */
-		freeScanStackEntry(so, stackEntry);
+done:
+		/* done with this work item */
+		spgFreeSearchItem(so, item);
 		/* clear temp context before proceeding to the next one */
 		MemoryContextReset(so->tempCxt);
 	}
@@ -565,8 +813,11 @@ redirect:
 /* storeRes subroutine for getbitmap case */
 static void
 storeBitmap(SpGistScanOpaque so, ItemPointer heapPtr,
-			Datum leafValue, bool isnull, bool recheck)
+			Datum leafValue, bool isnull, bool recheck,
+			bool recheckDistances, double *distances)
 {
+	Assert(so->numberOfOrderBys == 0);
+
 	tbm_add_tuples(so->tbm, heapPtr, 1, recheck);
 	so->ntids++;
 }
@@ -592,11 +843,20 @@ spggetbitmap(PG_FUNCTION_ARGS)
 /* storeRes subroutine for gettuple case */
 static void
 storeGettuple(SpGistScanOpaque so, ItemPointer heapPtr,
-			  Datum leafValue, bool isnull, bool recheck)
+			  Datum leafValue, bool isnull, bool recheck,
+			  bool recheckDistances, double *distances)
 {
 	Assert(so->nPtrs < MaxIndexTuplesPerPage);
 	so->heapPtrs[so->nPtrs] = *heapPtr;
 	so->recheck[so->nPtrs] = recheck;
+	if (so->numberOfOrderBys > 0)
+	{
+		/* ordered scans report one tuple at a time */
+		Assert(so->nPtrs == 0);
+		memcpy(so->distances, distances,
+			   sizeof(double) * so->numberOfOrderBys);
+		so->recheckDistances = recheckDistances;
+	}
 	if (so->want_itup)
 	{
 		/*
@@ -610,6 +870,54 @@ storeGettuple(SpGistScanOpaque so, ItemPointer heapPtr,
 	so->nPtrs++;
 }
 
+/*
+ * Return the distances of the tuple about to be returned by an ordered scan
+ * as the ORDER BY values, converting them to the ordering operators' result
+ * types.  This works like it does in GiST.
+ */
+static void
+spgStoreOrderByValues(IndexScanDesc scan, SpGistScanOpaque so)
+{
+	int			i;
+
+	scan->xs_recheckorderby = so->recheckDistances;
+	for (i = 0; i < so->numberOfOrderBys; i++)
+	{
+		if (so->orderByTypes[i] == FLOAT8OID)
+		{
+#ifndef USE_FLOAT8_BYVAL
+			/* must free any old value to avoid memory leakage */
+			if (!scan->xs_orderbynulls[i])
+				pfree(DatumGetPointer(scan->xs_orderbyvals[i]));
+#endif
+			scan->xs_orderbyvals[i] = Float8GetDatum(so->distances[i]);
+			scan->xs_orderbynulls[i] = false;
+		}
+		else if (so->orderByTypes[i] == FLOAT4OID)
+		{
+			/* convert distance function's result to ORDER BY type */
+#ifndef USE_FLOAT4_BYVAL
+			/* must free any old value to avoid memory leakage */
+			if (!scan->xs_orderbynulls[i])
+				pfree(DatumGetPointer(scan->xs_orderbyvals[i]));
+#endif
+			scan->xs_orderbyvals[i] = Float4GetDatum((float4) so->distances[i]);
+			scan->xs_orderbynulls[i] = false;
+		}
+		else
+		{
+			/*
+			 * We don't know how to convert the float8 distance to anything
+			 * else, but the executor only needs the values if they have to
+			 * be rechecked.
+			 */
+			if (scan->xs_recheckorderby)
+				elog(ERROR, "SP-GiST operator family's FOR ORDER BY operator must return float8 or float4 if the distance function is lossy");
+			scan->xs_orderbynulls[i] = true;
+		}
+	}
+}
+
 Datum
 spggettuple(PG_FUNCTION_ARGS)
 {
@@ -631,6 +939,8 @@ spggettuple(PG_FUNCTION_ARGS)
 			scan->xs_ctup.t_self = so->heapPtrs[so->iPtr];
 			scan->xs_recheck = so->recheck[so->iPtr];
 			scan->xs_itup = so->indexTups[so->iPtr];
+			if (so->numberOfOrderBys > 0)
+				spgStoreOrderByValues(scan, so);
 			so->iPtr++;
 			PG_RETURN_BOOL(true);
 		}
@@ -90,8 +90,9 @@ typedef struct CommitTimestampShared
 CommitTimestampShared *commitTsShared;
 
 
-/* GUC variable */
+/* GUC variables */
 bool		track_commit_timestamp;
+int			commit_timestamp_buffers = 0;
 
 static void SetXidCommitTsInPage(TransactionId xid, int nsubxids,
 					 TransactionId *subxids, TimestampTz ts,
@@ -437,12 +438,14 @@ pg_last_committed_xact(PG_FUNCTION_ARGS)
  * Number of shared CommitTS buffers.
  *
  * We use a very similar logic as for the number of CLOG buffers; see comments
- * in CLOGShmemBuffers.
+ * in CLOGShmemBuffers.  commit_timestamp_buffers overrides the formula if set.
  */
 Size
 CommitTsShmemBuffers(void)
 {
-	return Min(16, Max(4, NBuffers / 1024));
+	if (commit_timestamp_buffers > 0)
+		return commit_timestamp_buffers;
+	return Min(512, Max(SLRU_MIN_BUFFERS, NBuffers / 1024));
 }
 
 /*
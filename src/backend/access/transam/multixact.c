@@ -66,6 +66,7 @@
  */
 #include "postgres.h"
 
+#include "access/hash.h"
 #include "access/multixact.h"
 #include "access/slru.h"
 #include "access/transam.h"
@@ -85,6 +86,7 @@
 #include "storage/pmsignal.h"
 #include "storage/procarray.h"
 #include "utils/builtins.h"
+#include "utils/hsearch.h"
 #include "utils/memutils.h"
 #include "utils/snapmgr.h"
 
@@ -183,6 +185,10 @@ static SlruCtlData MultiXactMemberCtlData;
 #define MultiXactOffsetCtl	(&MultiXactOffsetCtlData)
 #define MultiXactMemberCtl	(&MultiXactMemberCtlData)
 
+/* GUC variables: number of SLRU buffers to use for multixact */
+int			multixact_offset_buffers = 8;
+int			multixact_member_buffers = 16;
+
 /*
  * MultiXact state shared across all backends.  All this state is protected
  * by MultiXactGenLock.  (We also use MultiXactOffsetControlLock and
@@ -298,31 +304,42 @@ static MultiXactId *OldestVisibleMXactId;
  * Definitions for the backend-local MultiXactId cache.
  *
  * We use this cache to store known MultiXacts, so we don't need to go to
- * SLRU areas every time.
- *
- * The cache lasts for the duration of a single transaction, the rationale
- * for this being that most entries will contain our own TransactionId and
- * so they will be uninteresting by the time our next transaction starts.
- * (XXX not clear that this is correct --- other members of the MultiXact
- * could hang around longer than we did.  However, it's not clear what a
- * better policy for flushing old cache entries would be.)	FIXME actually
- * this is plain wrong now that multixact's may contain update Xids.
- *
- * We allocate the cache entries in a memory context that is deleted at
- * transaction end, so we don't need to do retail freeing of entries.
+ * SLRU areas every time.  Entries are kept in LRU order, and are also
+ * entered in a hash table keyed by MultiXactId, since looking up the members
+ * of a multi is by far the most common operation.  Lookups by member set
+ * are only done when creating a new multi; each entry remembers a hash of
+ * its sorted member set to make those cheap to reject.
+ *
+ * The members of a MultiXactId never change, so the cache is kept across
+ * transactions: the multis locking a hot row, such as a foreign key's
+ * referenced row, are then mostly found here even though other backends
+ * created them.  The only danger is that MultiXactIds are reused after
+ * wraparound, so at transaction end we discard entries that precede the
+ * oldest multi still in use; no multi we look at within a transaction can
+ * be truncated away while we're in it, since OldestVisibleMXactId holds the
+ * horizon back.
  */
 typedef struct mXactCacheEnt
 {
 	MultiXactId multi;
 	int			nmembers;
+	uint32		sethash;		/* hash of the sorted members */
 	dlist_node	node;
 	MultiXactMember members[FLEXIBLE_ARRAY_MEMBER];
 } mXactCacheEnt;
 
-#define MAX_CACHE_ENTRIES	256
+typedef struct mXactCacheHashEnt
+{
+	MultiXactId multi;			/* hash key; must be first */
+	mXactCacheEnt *entry;
+} mXactCacheHashEnt;
+
+#define MAX_CACHE_ENTRIES	4096
 static dlist_head MXactCache = DLIST_STATIC_INIT(MXactCache);
+static HTAB *MXactCacheHash = NULL;
 static int	MXactCacheMembers = 0;
 static MemoryContext MXactContext = NULL;
+static MultiXactId MXactCachePrunedBefore = InvalidMultiXactId;
 
 #ifdef MULTIXACT_DEBUG
 #define debug_elog2(a,b) elog(a,b)
@@ -350,6 +367,8 @@ static MultiXactId mXactCacheGetBySet(int nmembers, MultiXactMember *members);
 static int	mXactCacheGetById(MultiXactId multi, MultiXactMember **members);
 static void mXactCachePut(MultiXactId multi, int nmembers,
 			  MultiXactMember *members);
+static void mXactCacheRemove(mXactCacheEnt *entry);
+static void mXactCachePrune(void);
 
 static char *mxstatus_to_string(MultiXactStatus status);
 
@@ -533,6 +552,92 @@ MultiXactIdExpand(MultiXactId multi, TransactionId xid, MultiXactStatus status)
 	return newMulti;
 }
 
+/*
+ * MultiXactIdExpandLockers
+ *		Add a TransactionId to a MultiXactId containing only lockers.
+ *
+ * This is a lighter-weight variant of MultiXactIdExpand for the common case
+ * where the existing multi has no updater, such as a row repeatedly locked
+ * FOR KEY SHARE by foreign key checks.  Instead of first checking whether
+ * the multi is still running and then expanding it, each looking up the
+ * members and checking all of them, we do both in a single pass.
+ *
+ * Returns InvalidMultiXactId if none of the existing members is still
+ * running; the caller should then lock the tuple with the plain xid, without
+ * creating a multi at all.
+ */
+MultiXactId
+MultiXactIdExpandLockers(MultiXactId multi, TransactionId xid,
+						 MultiXactStatus status)
+{
+	MultiXactId newMulti;
+	MultiXactMember *members;
+	MultiXactMember *newMembers;
+	int			nmembers;
+	int			i;
+	int			j;
+
+	AssertArg(MultiXactIdIsValid(multi));
+	AssertArg(TransactionIdIsValid(xid));
+
+	/* MultiXactIdSetOldestMember() must have been called already. */
+	Assert(MultiXactIdIsValid(OldestMemberMXactId[MyBackendId]));
+
+	debug_elog5(DEBUG2, "ExpandLockers: received multi %u, xid %u status %s",
+				multi, xid, mxstatus_to_string(status));
+
+	/* An old locker-only multi can't be running; see GetMultiXactIdMembers */
+	nmembers = GetMultiXactIdMembers(multi, &members, false, true);
+	if (nmembers <= 0)
+		return InvalidMultiXactId;
+
+	/*
+	 * If the TransactionId is already a member of the MultiXactId with the
+	 * same status, just return the existing MultiXactId; it is running,
+	 * since we are.
+	 */
+	for (i = 0; i < nmembers; i++)
+	{
+		Assert(!ISUPDATE_from_mxstatus(members[i].status));
+
+		if (TransactionIdEquals(members[i].xid, xid) &&
+			(members[i].status == status))
+		{
+			pfree(members);
+			return multi;
+		}
+	}
+
+	/* Keep only the lockers that are still running */
+	newMembers = (MultiXactMember *)
+		palloc(sizeof(MultiXactMember) * (nmembers + 1));
+
+	for (i = 0, j = 0; i < nmembers; i++)
+	{
+		if (TransactionIdIsInProgress(members[i].xid))
+		{
+			newMembers[j].xid = members[i].xid;
+			newMembers[j++].status = members[i].status;
+		}
+	}
+
+	if (j == 0)
+		newMulti = InvalidMultiXactId;
+	else
+	{
+		newMembers[j].xid = xid;
+		newMembers[j++].status = status;
+		newMulti = MultiXactIdCreateFromMembers(j, newMembers);
+	}
+
+	pfree(members);
+	pfree(newMembers);
+
+	debug_elog3(DEBUG2, "ExpandLockers: returning new multi %u", newMulti);
+
+	return newMulti;
+}
+
 /*
  * MultiXactIdIsRunning
  *		Returns whether a MultiXactId is "running".
@@ -1452,18 +1557,21 @@ static MultiXactId
 mXactCacheGetBySet(int nmembers, MultiXactMember *members)
 {
 	dlist_iter	iter;
+	uint32		sethash;
 
 	debug_elog3(DEBUG2, "CacheGet: looking for %s",
 				mxid_to_string(InvalidMultiXactId, nmembers, members));
 
 	/* sort the array so comparison is easy */
 	qsort(members, nmembers, sizeof(MultiXactMember), mxactMemberComparator);
+	sethash = DatumGetUInt32(hash_any((unsigned char *) members,
+									  nmembers * sizeof(MultiXactMember)));
 
 	dlist_foreach(iter, &MXactCache)
 	{
 		mXactCacheEnt *entry = dlist_container(mXactCacheEnt, node, iter.cur);
 
-		if (entry->nmembers != nmembers)
+		if (entry->sethash != sethash || entry->nmembers != nmembers)
 			continue;
 
 		/*
@@ -1493,43 +1601,37 @@ mXactCacheGetBySet(int nmembers, MultiXactMember *members)
 static int
 mXactCacheGetById(MultiXactId multi, MultiXactMember **members)
 {
-	dlist_iter	iter;
+	mXactCacheHashEnt *hentry;
+	mXactCacheEnt *entry;
+	MultiXactMember *ptr;
+	Size		size;
 
 	debug_elog3(DEBUG2, "CacheGet: looking for %u", multi);
 
-	dlist_foreach(iter, &MXactCache)
-	{
-		mXactCacheEnt *entry = dlist_container(mXactCacheEnt, node, iter.cur);
-
-		if (entry->multi == multi)
-		{
-			MultiXactMember *ptr;
-			Size		size;
+	if (MXactCacheHash == NULL)
+		return -1;
 
-			size = sizeof(MultiXactMember) * entry->nmembers;
-			ptr = (MultiXactMember *) palloc(size);
-			*members = ptr;
+	hentry = (mXactCacheHashEnt *) hash_search(MXactCacheHash, &multi,
+											   HASH_FIND, NULL);
+	if (hentry == NULL)
+	{
+		debug_elog2(DEBUG2, "CacheGet: not found");
+		return -1;
+	}
+	entry = hentry->entry;
 
-			memcpy(ptr, entry->members, size);
+	size = sizeof(MultiXactMember) * entry->nmembers;
+	ptr = (MultiXactMember *) palloc(size);
+	*members = ptr;
 
-			debug_elog3(DEBUG2, "CacheGet: found %s",
-						mxid_to_string(multi,
-									   entry->nmembers,
-									   entry->members));
+	memcpy(ptr, entry->members, size);
 
-			/*
-			 * Note we modify the list while not using a modifiable iterator.
-			 * This is acceptable only because we exit the iteration
-			 * immediately afterwards.
-			 */
-			dlist_move_head(&MXactCache, iter.cur);
+	debug_elog3(DEBUG2, "CacheGet: found %s",
+				mxid_to_string(multi, entry->nmembers, entry->members));
 
-			return entry->nmembers;
-		}
-	}
+	dlist_move_head(&MXactCache, &entry->node);
 
-	debug_elog2(DEBUG2, "CacheGet: not found");
-	return -1;
+	return entry->nmembers;
 }
 
 /*
@@ -1540,19 +1642,40 @@ static void
 mXactCachePut(MultiXactId multi, int nmembers, MultiXactMember *members)
 {
 	mXactCacheEnt *entry;
+	mXactCacheHashEnt *hentry;
+	bool		found;
 
 	debug_elog3(DEBUG2, "CachePut: storing %s",
 				mxid_to_string(multi, nmembers, members));
 
 	if (MXactContext == NULL)
 	{
-		/* The cache only lives as long as the current transaction */
+		HASHCTL		hash_ctl;
+
+		/* The cache lives for the life of the backend */
 		debug_elog2(DEBUG2, "CachePut: initializing memory context");
-		MXactContext = AllocSetContextCreate(TopTransactionContext,
+		MXactContext = AllocSetContextCreate(TopMemoryContext,
 											 "MultiXact Cache Context",
-											 ALLOCSET_SMALL_MINSIZE,
-											 ALLOCSET_SMALL_INITSIZE,
-											 ALLOCSET_SMALL_MAXSIZE);
+											 ALLOCSET_DEFAULT_MINSIZE,
+											 ALLOCSET_DEFAULT_INITSIZE,
+											 ALLOCSET_DEFAULT_MAXSIZE);
+
+		MemSet(&hash_ctl, 0, sizeof(hash_ctl));
+		hash_ctl.keysize = sizeof(MultiXactId);
+		hash_ctl.entrysize = sizeof(mXactCacheHashEnt);
+		hash_ctl.hcxt = MXactContext;
+		MXactCacheHash = hash_create("MultiXact Cache Hash",
+									 MAX_CACHE_ENTRIES, &hash_ctl,
+									 HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+
+	/* Don't enter the same multi twice */
+	hentry = (mXactCacheHashEnt *) hash_search(MXactCacheHash, &multi,
+											   HASH_FIND, NULL);
+	if (hentry != NULL)
+	{
+		dlist_move_head(&MXactCache, &hentry->entry->node);
+		return;
 	}
 
 	entry = (mXactCacheEnt *)
@@ -1566,25 +1689,72 @@ mXactCachePut(MultiXactId multi, int nmembers, MultiXactMember *members)
 
 	/* mXactCacheGetBySet assumes the entries are sorted, so sort them */
 	qsort(entry->members, nmembers, sizeof(MultiXactMember), mxactMemberComparator);
+	entry->sethash = DatumGetUInt32(hash_any((unsigned char *) entry->members,
+										 nmembers * sizeof(MultiXactMember)));
 
+	hentry = (mXactCacheHashEnt *) hash_search(MXactCacheHash, &multi,
+											   HASH_ENTER, &found);
+	Assert(!found);
+	hentry->entry = entry;
 	dlist_push_head(&MXactCache, &entry->node);
 	if (MXactCacheMembers++ >= MAX_CACHE_ENTRIES)
 	{
-		dlist_node *node;
-		mXactCacheEnt *entry;
+		mXactCacheEnt *oldest;
 
-		node = dlist_tail_node(&MXactCache);
-		dlist_delete(node);
-		MXactCacheMembers--;
-
-		entry = dlist_container(mXactCacheEnt, node, node);
+		oldest = dlist_container(mXactCacheEnt, node,
+								 dlist_tail_node(&MXactCache));
 		debug_elog3(DEBUG2, "CachePut: pruning cached multi %u",
-					entry->multi);
+					oldest->multi);
 
-		pfree(entry);
+		mXactCacheRemove(oldest);
 	}
 }
 
+/*
+ * mXactCacheRemove
+ *		Remove an entry from the local cache, and free it.
+ */
+static void
+mXactCacheRemove(mXactCacheEnt *entry)
+{
+	hash_search(MXactCacheHash, &entry->multi, HASH_REMOVE, NULL);
+	dlist_delete(&entry->node);
+	MXactCacheMembers--;
+	pfree(entry);
+}
+
+/*
+ * mXactCachePrune
+ *		Discard cache entries for multis that may have been truncated away,
+ *		and whose IDs could therefore be reused after wraparound.
+ *
+ * This is called at transaction end.  We only walk the cache when the oldest
+ * multi has advanced since the last time.
+ */
+static void
+mXactCachePrune(void)
+{
+	MultiXactId oldestMXact;
+	dlist_mutable_iter iter;
+
+	if (MXactCacheMembers == 0)
+		return;
+
+	/* We assume that reading a MultiXactId is atomic */
+	oldestMXact = MultiXactState->oldestMultiXactId;
+	if (oldestMXact == MXactCachePrunedBefore)
+		return;
+
+	dlist_foreach_modify(iter, &MXactCache)
+	{
+		mXactCacheEnt *entry = dlist_container(mXactCacheEnt, node, iter.cur);
+
+		if (MultiXactIdPrecedes(entry->multi, oldestMXact))
+			mXactCacheRemove(entry);
+	}
+	MXactCachePrunedBefore = oldestMXact;
+}
+
 static char *
 mxstatus_to_string(MultiXactStatus status)
 {
@@ -1652,13 +1822,8 @@ AtEOXact_MultiXact(void)
 	OldestMemberMXactId[MyBackendId] = InvalidMultiXactId;
 	OldestVisibleMXactId[MyBackendId] = InvalidMultiXactId;
 
-	/*
-	 * Discard the local MultiXactId cache.  Since MXactContext was created as
-	 * a child of TopTransactionContext, we needn't delete it explicitly.
-	 */
-	MXactContext = NULL;
-	dlist_init(&MXactCache);
-	MXactCacheMembers = 0;
+	/* Forget cached multis that may be truncated before we look again */
+	mXactCachePrune();
 }
 
 /*
@@ -1720,12 +1885,8 @@ PostPrepare_MultiXact(TransactionId xid)
 	 */
 	OldestVisibleMXactId[MyBackendId] = InvalidMultiXactId;
 
-	/*
-	 * Discard the local MultiXactId cache like in AtEOX_MultiXact
-	 */
-	MXactContext = NULL;
-	dlist_init(&MXactCache);
-	MXactCacheMembers = 0;
+	/* Prune the local MultiXactId cache like in AtEOXact_MultiXact */
+	mXactCachePrune();
 }
 
 /*
@@ -1791,8 +1952,8 @@ MultiXactShmemSize(void)
 			 mul_size(sizeof(MultiXactId) * 2, MaxOldestSlot))
 
 	size = SHARED_MULTIXACT_STATE_SIZE;
-	size = add_size(size, SimpleLruShmemSize(NUM_MXACTOFFSET_BUFFERS, 0));
-	size = add_size(size, SimpleLruShmemSize(NUM_MXACTMEMBER_BUFFERS, 0));
+	size = add_size(size, SimpleLruShmemSize(multixact_offset_buffers, 0));
+	size = add_size(size, SimpleLruShmemSize(multixact_member_buffers, 0));
 
 	return size;
 }
@@ -1808,10 +1969,10 @@ MultiXactShmemInit(void)
 	MultiXactMemberCtl->PagePrecedes = MultiXactMemberPagePrecedes;
 
 	SimpleLruInit(MultiXactOffsetCtl,
-				  "MultiXactOffset Ctl", NUM_MXACTOFFSET_BUFFERS, 0,
+				  "MultiXactOffset Ctl", multixact_offset_buffers, 0,
 				  MultiXactOffsetControlLock, "pg_multixact/offsets");
 	SimpleLruInit(MultiXactMemberCtl,
-				  "MultiXactMember Ctl", NUM_MXACTMEMBER_BUFFERS, 0,
+				  "MultiXactMember Ctl", multixact_member_buffers, 0,
 				  MultiXactMemberControlLock, "pg_multixact/members");
 
 	/* Initialize our shared state struct */
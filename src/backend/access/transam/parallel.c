@@ -22,6 +22,7 @@
 #include "libpq/pqformat.h"
 #include "libpq/pqmq.h"
 #include "miscadmin.h"
+#include "pgstat.h"
 #include "storage/ipc.h"
 #include "storage/sinval.h"
 #include "storage/spin.h"
@@ -95,6 +96,12 @@ int			ParallelWorkerNumber = -1;
 /* Is there a parallel message pending which we need to receive? */
 bool		ParallelMessagePending = false;
 
+/*
+ * May this worker insert tuples?  Parallel COPY FROM workers set this; they
+ * insert using the XID and command ID their leader set up beforehand.
+ */
+bool		ParallelWorkerInsertsAllowed = false;
+
 /* Pointer to our fixed parallel state. */
 static FixedParallelState *MyFixedParallelState;
 
@@ -416,8 +423,11 @@ LaunchParallelWorkers(ParallelContext *pcxt)
 		if (!any_registrations_failed &&
 			RegisterDynamicBackgroundWorker(&worker,
 											&pcxt->worker[i].bgwhandle))
+		{
 			shm_mq_set_handle(pcxt->worker[i].error_mqh,
 							  pcxt->worker[i].bgwhandle);
+			pcxt->nworkers_launched++;
+		}
 		else
 		{
 			/*
@@ -477,7 +487,9 @@ WaitForParallelWorkersToFinish(ParallelContext *pcxt)
 		if (!anyone_alive)
 			break;
 
+		pgstat_report_wait_start(WAIT_EVENT_PARALLEL_FINISH);
 		WaitLatch(&MyProc->procLatch, WL_LATCH_SET, -1);
+		pgstat_report_wait_end();
 		ResetLatch(&MyProc->procLatch);
 	}
 
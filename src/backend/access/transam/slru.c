@@ -7,11 +7,15 @@
  * buffers.  Under ordinary circumstances we expect that write
  * traffic will occur mostly to the latest page (and to the just-prior
  * page, soon after a page transition).  Read traffic will probably touch
- * a larger span of pages, but in any case a fairly small number of page
- * buffers should be sufficient.  So, we just search the buffers using plain
- * linear search; there's no need for a hashtable or anything fancy.
- * The management algorithm is straight LRU except that we will never swap
- * out the latest page (since we know it's going to be hit again eventually).
+ * a larger span of pages, and workloads with long-running transactions can
+ * need quite a lot of page buffers to avoid rereading old pages over and
+ * over.  To keep lookups cheap however many buffers are configured, the
+ * buffers are divided into banks (see SLRU_BANK_SIZE), and each page number
+ * maps to exactly one bank, in the manner of a set-associative cache.  A
+ * lookup or replacement only searches the target page's bank, using plain
+ * linear search.  Within a bank, the management algorithm is straight LRU
+ * except that we will never swap out the latest page (since we know it's
+ * going to be hit again eventually).
  *
  * We use a control LWLock to protect the shared data structures, plus
  * per-buffer LWLocks that synchronize I/O for each buffer.  The control lock
@@ -80,19 +84,36 @@ typedef struct SlruFlushData
 
 typedef struct SlruFlushData *SlruFlush;
 
+/*
+ * Macros to map a page number to the bank it must be kept in, to get the
+ * range of slots making up a bank, and to find the bank a slot belongs to.
+ * The last bank also takes the slots left over when num_slots isn't a
+ * multiple of SLRU_BANK_SIZE.
+ */
+#define SlruPageBank(shared, pageno) \
+	((int) ((uint32) (pageno) % (uint32) (shared)->num_banks))
+#define SlruBankStart(shared, bankno) \
+	((bankno) * SLRU_BANK_SIZE)
+#define SlruBankEnd(shared, bankno) \
+	((bankno) == (shared)->num_banks - 1 ? \
+	 (shared)->num_slots : ((bankno) + 1) * SLRU_BANK_SIZE)
+#define SlruSlotBank(shared, slotno) \
+	Min((slotno) / SLRU_BANK_SIZE, (shared)->num_banks - 1)
+
 /*
  * Macro to mark a buffer slot "most recently used".  Note multiple evaluation
  * of arguments!
  *
  * The reason for the if-test is that there are often many consecutive
  * accesses to the same page (particularly the latest page).  By suppressing
- * useless increments of cur_lru_count, we reduce the probability that old
- * pages' counts will "wrap around" and make them appear recently used.
+ * useless increments of the bank's cur_lru_count, we reduce the probability
+ * that old pages' counts will "wrap around" and make them appear recently
+ * used.
  *
  * We allow this code to be executed concurrently by multiple processes within
  * SimpleLruReadPage_ReadOnly().  As long as int reads and writes are atomic,
  * this should not cause any completely-bogus values to enter the computation.
- * However, it is possible for either cur_lru_count or individual
+ * However, it is possible for either the bank's cur_lru_count or individual
  * page_lru_count entries to be "reset" to lower values than they should have,
  * in case a process is delayed while it executes this macro.  With care in
  * SlruSelectLRUPage(), this does little harm, and in any case the absolute
@@ -101,9 +122,10 @@ typedef struct SlruFlushData *SlruFlush;
  */
 #define SlruRecentlyUsed(shared, slotno)	\
 	do { \
-		int		new_lru_count = (shared)->cur_lru_count; \
+		int		bankno = SlruSlotBank(shared, slotno); \
+		int		new_lru_count = (shared)->bank_cur_lru_count[bankno]; \
 		if (new_lru_count != (shared)->page_lru_count[slotno]) { \
-			(shared)->cur_lru_count = ++new_lru_count; \
+			(shared)->bank_cur_lru_count[bankno] = ++new_lru_count; \
 			(shared)->page_lru_count[slotno] = new_lru_count; \
 		} \
 	} while (0)
@@ -142,10 +164,12 @@ static bool SlruScanDirCbDeleteCutoff(SlruCtl ctl, char *filename,
 Size
 SimpleLruShmemSize(int nslots, int nlsns)
 {
+	int			nbanks = Max(nslots / SLRU_BANK_SIZE, 1);
 	Size		sz;
 
 	/* we assume nslots isn't so large as to risk overflow */
 	sz = MAXALIGN(sizeof(SlruSharedData));
+	sz += MAXALIGN(nbanks * sizeof(int));		/* bank_cur_lru_count[] */
 	sz += MAXALIGN(nslots * sizeof(char *));	/* page_buffer[] */
 	sz += MAXALIGN(nslots * sizeof(SlruPageStatus));	/* page_status[] */
 	sz += MAXALIGN(nslots * sizeof(bool));		/* page_dirty[] */
@@ -179,19 +203,23 @@ SimpleLruInit(SlruCtl ctl, const char *name, int nslots, int nlsns,
 
 		Assert(!found);
 
+		Assert(nslots >= SLRU_MIN_BUFFERS);
+
 		memset(shared, 0, sizeof(SlruSharedData));
 
 		shared->ControlLock = ctllock;
 
 		shared->num_slots = nslots;
+		shared->num_banks = Max(nslots / SLRU_BANK_SIZE, 1);
 		shared->lsn_groups_per_page = nlsns;
 
-		shared->cur_lru_count = 0;
-
 		/* shared->latest_page_number will be set later */
 
 		ptr = (char *) shared;
 		offset = MAXALIGN(sizeof(SlruSharedData));
+		shared->bank_cur_lru_count = (int *) (ptr + offset);
+		MemSet(shared->bank_cur_lru_count, 0, shared->num_banks * sizeof(int));
+		offset += MAXALIGN(shared->num_banks * sizeof(int));
 		shared->page_buffer = (char **) (ptr + offset);
 		offset += MAXALIGN(nslots * sizeof(char *));
 		shared->page_status = (SlruPageStatus *) (ptr + offset);
@@ -450,13 +478,15 @@ int
 SimpleLruReadPage_ReadOnly(SlruCtl ctl, int pageno, TransactionId xid)
 {
 	SlruShared	shared = ctl->shared;
+	int			bankno = SlruPageBank(shared, pageno);
+	int			bankend = SlruBankEnd(shared, bankno);
 	int			slotno;
 
 	/* Try to find the page while holding only shared lock */
 	LWLockAcquire(shared->ControlLock, LW_SHARED);
 
-	/* See if page is already in a buffer */
-	for (slotno = 0; slotno < shared->num_slots; slotno++)
+	/* See if page is already in a buffer of its bank */
+	for (slotno = SlruBankStart(shared, bankno); slotno < bankend; slotno++)
 	{
 		if (shared->page_number[slotno] == pageno &&
 			shared->page_status[slotno] != SLRU_PAGE_EMPTY &&
@@ -941,6 +971,9 @@ static int
 SlruSelectLRUPage(SlruCtl ctl, int pageno)
 {
 	SlruShared	shared = ctl->shared;
+	int			bankno = SlruPageBank(shared, pageno);
+	int			bankstart = SlruBankStart(shared, bankno);
+	int			bankend = SlruBankEnd(shared, bankno);
 
 	/* Outer loop handles restart after I/O */
 	for (;;)
@@ -954,8 +987,8 @@ SlruSelectLRUPage(SlruCtl ctl, int pageno)
 		int			best_invalid_delta = -1;
 		int			best_invalid_page_number = 0;		/* keep compiler quiet */
 
-		/* See if page already has a buffer assigned */
-		for (slotno = 0; slotno < shared->num_slots; slotno++)
+		/* See if page already has a buffer assigned in its bank */
+		for (slotno = bankstart; slotno < bankend; slotno++)
 		{
 			if (shared->page_number[slotno] == pageno &&
 				shared->page_status[slotno] != SLRU_PAGE_EMPTY)
@@ -963,8 +996,8 @@ SlruSelectLRUPage(SlruCtl ctl, int pageno)
 		}
 
 		/*
-		 * If we find any EMPTY slot, just select that one. Else choose a
-		 * victim page to replace.  We normally take the least recently used
+		 * If we find any EMPTY slot in the bank, just select that one. Else
+		 * choose a victim page in the bank to replace.  We normally take the least recently used
 		 * valid page, but we will never take the slot containing
 		 * latest_page_number, even if it appears least recently used.  We
 		 * will select a slot that is already I/O busy only if there is no
@@ -981,16 +1014,17 @@ SlruSelectLRUPage(SlruCtl ctl, int pageno)
 		 * acquire the same lru_count values.  In that case we break ties by
 		 * choosing the furthest-back page.
 		 *
-		 * Notice that this next line forcibly advances cur_lru_count to a
-		 * value that is certainly beyond any value that will be in the
-		 * page_lru_count array after the loop finishes.  This ensures that
-		 * the next execution of SlruRecentlyUsed will mark the page newly
-		 * used, even if it's for a page that has the current counter value.
-		 * That gets us back on the path to having good data when there are
-		 * multiple pages with the same lru_count.
+		 * Notice that this next line forcibly advances the bank's
+		 * cur_lru_count to a value that is certainly beyond any value that
+		 * will be in the bank's page_lru_count entries after the loop
+		 * finishes.  This ensures that the next execution of
+		 * SlruRecentlyUsed will mark the page newly used, even if it's for a
+		 * page that has the current counter value.  That gets us back on the
+		 * path to having good data when there are multiple pages with the
+		 * same lru_count.
 		 */
-		cur_count = (shared->cur_lru_count)++;
-		for (slotno = 0; slotno < shared->num_slots; slotno++)
+		cur_count = (shared->bank_cur_lru_count[bankno])++;
+		for (slotno = bankstart; slotno < bankend; slotno++)
 		{
 			int			this_delta;
 			int			this_page_number;
@@ -61,6 +61,39 @@ static SlruCtlData SubTransCtlData;
 
 #define SubTransCtl  (&SubTransCtlData)
 
+/* GUC variable: number of SLRU buffers to use for subtrans */
+int			subtransaction_buffers = 32;
+
+/*
+ * Backend-local cache of SubTransGetTopmostTransaction results.
+ *
+ * Once a backend's PGPROC subxid cache has overflowed, every snapshot taken
+ * in the cluster is marked suboverflowed, and XidInMVCCSnapshot has to map
+ * each XID it checks to its topmost parent through pg_subtrans.  A scan
+ * typically checks the same few XIDs over and over, so we remember recent
+ * answers in a small direct-mapped table to avoid most of that SLRU traffic.
+ *
+ * A parent link never changes once set, but the answer also depends on
+ * TransactionXmin, since we stop walking up the tree there; and XIDs are
+ * eventually reused after wraparound.  So the table is only trusted for the
+ * TransactionXmin it was filled under, and is emptied when that changes.
+ *
+ * A parent link can be set after we first look, though: on a hot standby,
+ * the parents of subtransactions are only recorded when the XID assignment
+ * record is replayed.  So we don't remember that an XID had no parent;
+ * only answers that found one are kept.
+ */
+#define TOPMOST_CACHE_SIZE	4096		/* must be a power of 2 */
+
+typedef struct TopmostCacheEntry
+{
+	TransactionId xid;			/* InvalidTransactionId if unused */
+	TransactionId topmostXid;
+} TopmostCacheEntry;
+
+static TopmostCacheEntry topmostCache[TOPMOST_CACHE_SIZE];
+static TransactionId topmostCacheXmin = InvalidTransactionId;
+
 
 static int	ZeroSUBTRANSPage(int pageno);
 static bool SubTransPagePrecedes(int page1, int page2);
@@ -147,10 +180,21 @@ SubTransGetTopmostTransaction(TransactionId xid)
 {
 	TransactionId parentXid = xid,
 				previousXid = xid;
+	TopmostCacheEntry *entry;
 
 	/* Can't ask about stuff that might not be around anymore */
 	Assert(TransactionIdFollowsOrEquals(xid, TransactionXmin));
 
+	/* Consult the local cache first, resetting it if it has gone stale */
+	if (topmostCacheXmin != TransactionXmin)
+	{
+		MemSet(topmostCache, 0, sizeof(topmostCache));
+		topmostCacheXmin = TransactionXmin;
+	}
+	entry = &topmostCache[xid & (TOPMOST_CACHE_SIZE - 1)];
+	if (TransactionIdEquals(entry->xid, xid))
+		return entry->topmostXid;
+
 	while (TransactionIdIsValid(parentXid))
 	{
 		previousXid = parentXid;
@@ -161,6 +205,13 @@ SubTransGetTopmostTransaction(TransactionId xid)
 
 	Assert(TransactionIdIsValid(previousXid));
 
+	/* "no parent (yet)" mustn't be cached, see above */
+	if (!TransactionIdEquals(previousXid, xid))
+	{
+		entry->xid = xid;
+		entry->topmostXid = previousXid;
+	}
+
 	return previousXid;
 }
 
@@ -171,14 +222,14 @@ SubTransGetTopmostTransaction(TransactionId xid)
 Size
 SUBTRANSShmemSize(void)
 {
-	return SimpleLruShmemSize(NUM_SUBTRANS_BUFFERS, 0);
+	return SimpleLruShmemSize(subtransaction_buffers, 0);
 }
 
 void
 SUBTRANSShmemInit(void)
 {
 	SubTransCtl->PagePrecedes = SubTransPagePrecedes;
-	SimpleLruInit(SubTransCtl, "SUBTRANS Ctl", NUM_SUBTRANS_BUFFERS, 0,
+	SimpleLruInit(SubTransCtl, "SUBTRANS Ctl", subtransaction_buffers, 0,
 				  SubtransControlLock, "pg_subtrans");
 	/* Override default assumption that writes should be fsync'd */
 	SubTransCtl->do_fsync = false;
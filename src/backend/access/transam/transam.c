@@ -25,14 +25,28 @@
 #include "utils/snapmgr.h"
 
 /*
- * Single-item cache for results of TransactionLogFetch.  It's worth having
- * such a cache because we frequently find ourselves repeatedly checking the
- * same XID, for example when scanning a table just after a bulk insert,
- * update, or delete.
+ * Small cache for results of TransactionLogFetch.  It's worth having such a
+ * cache because we frequently find ourselves repeatedly checking the same
+ * XID, for example when scanning a table just after a bulk insert, update,
+ * or delete.  A single entry takes care of that case, but a table loaded or
+ * modified by a mix of concurrent transactions makes a lone entry thrash, so
+ * we keep a few, direct-mapped by XID so that a lookup costs no more than
+ * with a single entry.  An entry whose xid is InvalidTransactionId is
+ * unused; as that is zero, the array starts out empty.
  */
-static TransactionId cachedFetchXid = InvalidTransactionId;
-static XidStatus cachedFetchXidStatus;
-static XLogRecPtr cachedCommitLSN;
+#define XID_STATUS_CACHE_SIZE	32		/* must be a power of 2 */
+
+typedef struct XidStatusCacheEntry
+{
+	TransactionId xid;
+	XidStatus	status;
+	XLogRecPtr	commitLSN;
+} XidStatusCacheEntry;
+
+static XidStatusCacheEntry xidStatusCache[XID_STATUS_CACHE_SIZE];
+
+#define XidStatusCacheSlot(xid) \
+	(&xidStatusCache[(xid) & (XID_STATUS_CACHE_SIZE - 1)])
 
 /* Local functions */
 static XidStatus TransactionLogFetch(TransactionId transactionId);
@@ -51,15 +65,16 @@ static XidStatus TransactionLogFetch(TransactionId transactionId);
 static XidStatus
 TransactionLogFetch(TransactionId transactionId)
 {
+	XidStatusCacheEntry *entry = XidStatusCacheSlot(transactionId);
 	XidStatus	xidstatus;
 	XLogRecPtr	xidlsn;
 
 	/*
-	 * Before going to the commit log manager, check our single item cache to
-	 * see if we didn't just check the transaction status a moment ago.
+	 * Before going to the commit log manager, check our cache to see if we
+	 * didn't just check the transaction status a moment ago.
 	 */
-	if (TransactionIdEquals(transactionId, cachedFetchXid))
-		return cachedFetchXidStatus;
+	if (TransactionIdEquals(transactionId, entry->xid))
+		return entry->status;
 
 	/*
 	 * Also, check to see if the transaction ID is a permanent one.
@@ -85,9 +100,9 @@ TransactionLogFetch(TransactionId transactionId)
 	if (xidstatus != TRANSACTION_STATUS_IN_PROGRESS &&
 		xidstatus != TRANSACTION_STATUS_SUB_COMMITTED)
 	{
-		cachedFetchXid = transactionId;
-		cachedFetchXidStatus = xidstatus;
-		cachedCommitLSN = xidlsn;
+		entry->xid = transactionId;
+		entry->status = xidstatus;
+		entry->commitLSN = xidlsn;
 	}
 
 	return xidstatus;
@@ -237,7 +252,8 @@ TransactionIdDidAbort(TransactionId transactionId)
 bool
 TransactionIdIsKnownCompleted(TransactionId transactionId)
 {
-	if (TransactionIdEquals(transactionId, cachedFetchXid))
+	if (TransactionIdEquals(transactionId,
+							XidStatusCacheSlot(transactionId)->xid))
 	{
 		/* If it's in the cache at all, it must be completed. */
 		return true;
@@ -401,6 +417,7 @@ TransactionIdLatest(TransactionId mainxid,
 XLogRecPtr
 TransactionIdGetCommitLSN(TransactionId xid)
 {
+	XidStatusCacheEntry *entry = XidStatusCacheSlot(xid);
 	XLogRecPtr	result;
 
 	/*
@@ -409,8 +426,8 @@ TransactionIdGetCommitLSN(TransactionId xid)
 	 * checking TransactionLogFetch's cache will usually succeed and avoid an
 	 * extra trip to shared memory.
 	 */
-	if (TransactionIdEquals(xid, cachedFetchXid))
-		return cachedCommitLSN;
+	if (TransactionIdEquals(xid, entry->xid))
+		return entry->commitLSN;
 
 	/* Special XIDs are always known committed */
 	if (!TransactionIdIsNormal(xid))
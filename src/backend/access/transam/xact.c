@@ -611,9 +611,13 @@ AssignTransactionId(TransactionState s)
 		/*
 		 * ensure this test matches similar one in
 		 * RecoverPreparedTransactions()
+		 *
+		 * Logical decoding needs to know which toplevel transaction a subxact
+		 * belongs to before the commit record to stream in-progress
+		 * transactions, so always report the assignment right away then.
 		 */
 		if (nUnreportedXids >= PGPROC_MAX_CACHED_SUBXIDS ||
-			log_unknown_top)
+			log_unknown_top || XLogLogicalInfoActive())
 		{
 			xl_xact_assignment xlrec;
 
@@ -2433,6 +2437,9 @@ AbortTransaction(void)
 	 */
 	LWLockReleaseAll();
 
+	/* Clear any wait event an error left behind */
+	pgstat_report_wait_end();
+
 	/* Clean up buffer I/O and buffer context locks, too */
 	AbortBufferIO();
 	UnlockBuffers();
@@ -4524,6 +4531,7 @@ AbortSubTransaction(void)
 	 */
 	LWLockReleaseAll();
 
+	pgstat_report_wait_end();
 	AbortBufferIO();
 	UnlockBuffers();
 
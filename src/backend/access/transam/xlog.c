@@ -33,6 +33,8 @@
 #include "access/xact.h"
 #include "access/xlog_internal.h"
 #include "access/xloginsert.h"
+#include "access/xlogprefetch.h"
+#include "access/xlogredoworker.h"
 #include "access/xlogreader.h"
 #include "access/xlogutils.h"
 #include "catalog/catversion.h"
@@ -40,8 +42,10 @@
 #include "catalog/pg_database.h"
 #include "miscadmin.h"
 #include "pgstat.h"
+#include "portability/instr_time.h"
 #include "postmaster/bgwriter.h"
 #include "postmaster/startup.h"
+#include "postmaster/walwriter.h"
 #include "replication/basebackup.h"
 #include "replication/logical.h"
 #include "replication/slot.h"
@@ -91,25 +95,20 @@ char	   *XLogArchiveCommand = NULL;
 bool		EnableHotStandby = false;
 bool		fullPageWrites = true;
 bool		wal_log_hints = false;
-bool		wal_compression = false;
+int			wal_compression = WAL_COMPRESSION_NONE;
 bool		log_checkpoints = false;
 int			sync_method = DEFAULT_SYNC_METHOD;
 int			wal_level = WAL_LEVEL_MINIMAL;
-int			CommitDelay = 0;	/* precommit delay in microseconds */
+int			CommitDelay = 0;	/* precommit delay in microseconds, or -1 for
+								 * an adaptive delay */
 int			CommitSiblings = 5; /* # concurrent xacts needed to sleep */
 int			wal_retrieve_retry_interval = 5000;
+int			wal_insert_locks = 8;
 
 #ifdef WAL_DEBUG
 bool		XLOG_DEBUG = false;
 #endif
 
-/*
- * Number of WAL insertion locks to use. A higher value allows more insertions
- * to happen concurrently, but adds some CPU overhead to flushing the WAL,
- * which needs to iterate all the locks.
- */
-#define NUM_XLOGINSERT_LOCKS  8
-
 /*
  * Max distance from last checkpoint, before triggering a new xlog-based
  * checkpoint.
@@ -158,6 +157,29 @@ const struct config_enum_entry archive_mode_options[] = {
 	{NULL, 0, false}
 };
 
+/*
+ * "on" selects pglz, which was the only method before others were added.
+ * Methods the server was built without are not accepted at all.
+ */
+const struct config_enum_entry wal_compression_options[] = {
+	{"pglz", WAL_COMPRESSION_PGLZ, false},
+#ifdef USE_LZ4
+	{"lz4", WAL_COMPRESSION_LZ4, false},
+#endif
+#ifdef USE_ZSTD
+	{"zstd", WAL_COMPRESSION_ZSTD, false},
+#endif
+	{"on", WAL_COMPRESSION_PGLZ, false},
+	{"off", WAL_COMPRESSION_NONE, false},
+	{"true", WAL_COMPRESSION_PGLZ, true},
+	{"false", WAL_COMPRESSION_NONE, true},
+	{"yes", WAL_COMPRESSION_PGLZ, true},
+	{"no", WAL_COMPRESSION_NONE, true},
+	{"1", WAL_COMPRESSION_PGLZ, true},
+	{"0", WAL_COMPRESSION_NONE, true},
+	{NULL, 0, false}
+};
+
 /*
  * Statistics for current checkpoint are collected in this global struct.
  * Because only the checkpointer or a stand-alone backend can perform
@@ -244,6 +266,7 @@ static bool restoredFromArchive = false;
 
 /* options taken from recovery.conf for archive recovery */
 char	   *recoveryRestoreCommand = NULL;
+int			recoveryRestorePrefetch = 0;
 static char *recoveryEndCommand = NULL;
 static char *archiveCleanupCommand = NULL;
 static RecoveryTargetType recoveryTarget = RECOVERY_TARGET_UNSET;
@@ -455,29 +478,50 @@ typedef union WALInsertLockPadded
 	char		pad[PG_CACHE_LINE_SIZE];
 } WALInsertLockPadded;
 
+/*
+ * A prev-link hands the start position of a WAL record over to the record
+ * reserved right after it, which needs it for its xl_prev; see
+ * ReserveXLogInsertLocation().  endpos is the end of the record (and thus
+ * the start of the next one), or one of the special values below if the
+ * entry is not in use.  Both positions are "usable byte positions".
+ *
+ * Like the insertion locks, the entries are padded to a full cache line, as
+ * each one is written by a different inserter than the one reading it.
+ */
+#define XLOG_PREVLINK_FREE		UINT64CONST(0)
+#define XLOG_PREVLINK_CLAIMED	PG_UINT64_MAX
+
+typedef struct
+{
+	pg_atomic_uint64 endpos;
+	uint64		startpos;
+} XLogPrevLink;
+
+typedef union XLogPrevLinkPadded
+{
+	XLogPrevLink l;
+	char		pad[PG_CACHE_LINE_SIZE];
+} XLogPrevLinkPadded;
+
 /*
  * Shared state data for WAL insertion.
  */
 typedef struct XLogCtlInsert
 {
-	slock_t		insertpos_lck;	/* protects CurrBytePos and PrevBytePos */
-
 	/*
 	 * CurrBytePos is the end of reserved WAL. The next record will be
-	 * inserted at that position. PrevBytePos is the start position of the
-	 * previously inserted (or rather, reserved) record - it is copied to the
-	 * prev-link of the next record. These are stored as "usable byte
-	 * positions" rather than XLogRecPtrs (see XLogBytePosToRecPtr()).
+	 * inserted at that position. It is stored as a "usable byte position"
+	 * rather than an XLogRecPtr (see XLogBytePosToRecPtr()), so that space
+	 * can be reserved with a single atomic fetch-and-add.
 	 */
-	uint64		CurrBytePos;
-	uint64		PrevBytePos;
+	pg_atomic_uint64 CurrBytePos;
 
 	/*
-	 * Make sure the above heavily-contended spinlock and byte positions are
-	 * on their own cache line. In particular, the RedoRecPtr and full page
-	 * write variables below should be on a different cache line. They are
-	 * read on every WAL insertion, but updated rarely, and we don't want
-	 * those reads to steal the cache line containing Curr/PrevBytePos.
+	 * Make sure the above heavily-contended byte position is on its own
+	 * cache line. In particular, the RedoRecPtr and full page write variables
+	 * below should be on a different cache line. They are read on every WAL
+	 * insertion, but updated rarely, and we don't want those reads to steal
+	 * the cache line containing CurrBytePos.
 	 */
 	char		pad[PG_CACHE_LINE_SIZE];
 
@@ -512,6 +556,12 @@ typedef struct XLogCtlInsert
 	WALInsertLockPadded *WALInsertLocks;
 	LWLockTranche WALInsertLockTranche;
 	int			WALInsertLockTrancheId;
+
+	/*
+	 * Hash table of prev-links, with numPrevLinks (a power of 2) entries.
+	 */
+	XLogPrevLinkPadded *PrevLinks;
+	int			numPrevLinks;
 } XLogCtlInsert;
 
 /*
@@ -521,6 +571,13 @@ typedef struct XLogCtlData
 {
 	XLogCtlInsert Insert;
 
+	/*
+	 * All WAL insertions before this point are known to have finished, so
+	 * WaitXLogInsertionsToFinish() needn't look at the insertion locks to
+	 * wait for anything older.  Only ever advances.
+	 */
+	pg_atomic_uint64 insertsFinishedUpto;
+
 	/* Protected by info_lck: */
 	XLogwrtRqst LogwrtRqst;
 	XLogRecPtr	RedoRecPtr;		/* a recent copy of Insert->RedoRecPtr */
@@ -645,6 +702,16 @@ typedef struct XLogCtlData
 	 */
 	XLogRecPtr	lastFpwDisableRecPtr;
 
+	/*
+	 * Moving averages of the time between requests to flush WAL, and of the
+	 * time the flushes take, in microseconds, for the adaptive commit_delay.
+	 * lastFlushRequest and avgFlushRequestInterval are protected by
+	 * info_lck, avgFlushTime by WALWriteLock.
+	 */
+	TimestampTz lastFlushRequest;
+	double		avgFlushRequestInterval;
+	double		avgFlushTime;
+
 	slock_t		info_lck;		/* locks shared variables shown above */
 } XLogCtlData;
 
@@ -805,6 +872,7 @@ static XLogRecPtr XLogGetReplicationSlotMinimumLSN(void);
 static void AdvanceXLInsertBuffer(XLogRecPtr upto, bool opportunistic);
 static bool XLogCheckpointNeeded(XLogSegNo new_segno);
 static void XLogWrite(XLogwrtRqst WriteRqst, bool flexible);
+static int	AdaptiveCommitDelay(void);
 static bool InstallXLogFileSegment(XLogSegNo *segno, char *tmppath,
 					   bool find_free, XLogSegNo max_segno,
 					   bool use_lock, int elevel);
@@ -855,6 +923,8 @@ static void ReserveXLogInsertLocation(int size, XLogRecPtr *StartPos,
 						  XLogRecPtr *EndPos, XLogRecPtr *PrevPtr);
 static bool ReserveXLogSwitch(XLogRecPtr *StartPos, XLogRecPtr *EndPos,
 				  XLogRecPtr *PrevPtr);
+static void XLogPublishPrevLink(uint64 endbytepos, uint64 startbytepos);
+static uint64 XLogGetPrevLink(uint64 bytepos, bool consume);
 static XLogRecPtr WaitXLogInsertionsToFinish(XLogRecPtr upto);
 static char *GetXLogBuffer(XLogRecPtr ptr);
 static XLogRecPtr XLogBytePosToRecPtr(uint64 bytepos);
@@ -915,8 +985,8 @@ XLogInsertRecord(XLogRecData *rdata, XLogRecPtr fpw_lsn)
 	 * record to the shared WAL buffer cache is a two-step process:
 	 *
 	 * 1. Reserve the right amount of space from the WAL. The current head of
-	 *	  reserved space is kept in Insert->CurrBytePos, and is protected by
-	 *	  insertpos_lck.
+	 *	  reserved space is kept in Insert->CurrBytePos, and is advanced with
+	 *	  an atomic fetch-and-add.
 	 *
 	 * 2. Copy the record to the reserved WAL space. This involves finding the
 	 *	  correct WAL buffer containing the reserved space, and copying the
@@ -925,10 +995,10 @@ XLogInsertRecord(XLogRecData *rdata, XLogRecPtr fpw_lsn)
 	 * To keep track of which insertions are still in-progress, each concurrent
 	 * inserter acquires an insertion lock. In addition to just indicating that
 	 * an insertion is in progress, the lock tells others how far the inserter
-	 * has progressed. There is a small fixed number of insertion locks,
-	 * determined by NUM_XLOGINSERT_LOCKS. When an inserter crosses a page
-	 * boundary, it updates the value stored in the lock to the how far it has
-	 * inserted, to allow the previous buffer to be flushed.
+	 * has progressed. There is a small number of insertion locks, set by
+	 * wal_insert_locks. When an inserter crosses a page boundary, it updates
+	 * the value stored in the lock to the how far it has inserted, to allow
+	 * the previous buffer to be flushed.
 	 *
 	 * Holding onto an insertion lock also protects RedoRecPtr and
 	 * fullPageWrites from changing until the insertion is finished.
@@ -1037,6 +1107,21 @@ XLogInsertRecord(XLogRecData *rdata, XLogRecPtr fpw_lsn)
 		/* update local result copy while I have the chance */
 		LogwrtResult = XLogCtl->LogwrtResult;
 		SpinLockRelease(&XLogCtl->info_lck);
+
+		/*
+		 * If we completed a unit of wal_writer_flush_after that hasn't been
+		 * written yet, wake up the WAL writer to write and flush it, so that
+		 * committing backends find less to write themselves.
+		 */
+		if (WalWriterFlushAfter > 0)
+		{
+			uint64		unit = (uint64) WalWriterFlushAfter * XLOG_BLCKSZ;
+
+			if (StartPos / unit != EndPos / unit &&
+				LogwrtResult.Write < EndPos - EndPos % unit &&
+				ProcGlobal->walwriterLatch)
+				SetLatch(ProcGlobal->walwriterLatch);
+		}
 	}
 
 	/*
@@ -1126,6 +1211,99 @@ XLogInsertRecord(XLogRecData *rdata, XLogRecPtr fpw_lsn)
 	return EndPos;
 }
 
+/*
+ * Publish the prev-link of a just-reserved record, so that the record
+ * reserved after it (starting at endbytepos) can find out where this one
+ * starts.
+ *
+ * Every record's link is picked up by its successor, which does so while
+ * holding a WAL insertion lock, right after its own reservation.  So there
+ * can be at most one unclaimed link per insertion lock, plus one for the
+ * latest record, and as the table is sized at several times that, there is
+ * always a free entry to be found.
+ */
+static void
+XLogPublishPrevLink(uint64 endbytepos, uint64 startbytepos)
+{
+	XLogCtlInsert *Insert = &XLogCtl->Insert;
+	uint32		mask = Insert->numPrevLinks - 1;
+	uint32		slot;
+
+	Assert(endbytepos != XLOG_PREVLINK_FREE &&
+		   endbytepos != XLOG_PREVLINK_CLAIMED);
+
+	slot = (uint32) (endbytepos / MAXIMUM_ALIGNOF) & mask;
+	for (;;)
+	{
+		XLogPrevLink *link = &Insert->PrevLinks[slot].l;
+		uint64		expected = XLOG_PREVLINK_FREE;
+
+		/*
+		 * Claim a free entry before filling it in, so that nobody can mistake
+		 * it for a complete link in the meantime.
+		 */
+		if (pg_atomic_read_u64(&link->endpos) == XLOG_PREVLINK_FREE &&
+			pg_atomic_compare_exchange_u64(&link->endpos, &expected,
+										   XLOG_PREVLINK_CLAIMED))
+		{
+			link->startpos = startbytepos;
+			pg_write_barrier();
+			pg_atomic_write_u64(&link->endpos, endbytepos);
+			return;
+		}
+		slot = (slot + 1) & mask;
+	}
+}
+
+/*
+ * Look up the prev-link of the record ending at bytepos, and return the
+ * start position of that record.  If consume is true, the entry is freed.
+ *
+ * The record in question has already been reserved, but its inserter might
+ * not have gotten around to publishing the link yet, in which case we spin
+ * until it does.  That's only a few instructions, so the wait is short.
+ */
+static uint64
+XLogGetPrevLink(uint64 bytepos, bool consume)
+{
+	XLogCtlInsert *Insert = &XLogCtl->Insert;
+	uint32		mask = Insert->numPrevLinks - 1;
+	uint32		first = (uint32) (bytepos / MAXIMUM_ALIGNOF) & mask;
+	SpinDelayStatus delayStatus;
+
+	init_spin_delay(&delayStatus, Insert->PrevLinks);
+	for (;;)
+	{
+		uint32		i;
+
+		/*
+		 * Entries are freed in no particular order, so a free entry doesn't
+		 * end the search.  We have to look at all of them, but the one we
+		 * want is normally right at the start.
+		 */
+		for (i = 0; i <= mask; i++)
+		{
+			XLogPrevLink *link = &Insert->PrevLinks[(first + i) & mask].l;
+			uint64		prevbytepos;
+
+			if (pg_atomic_read_u64(&link->endpos) != bytepos)
+				continue;
+
+			pg_read_barrier();
+			prevbytepos = link->startpos;
+			if (consume)
+			{
+				/* make sure we've read startpos before handing the entry back */
+				pg_memory_barrier();
+				pg_atomic_write_u64(&link->endpos, XLOG_PREVLINK_FREE);
+			}
+			finish_spin_delay(&delayStatus);
+			return prevbytepos;
+		}
+		perform_spin_delay(&delayStatus);
+	}
+}
+
 /*
  * Reserves the right amount of space for a record of given size from the WAL.
  * *StartPos is set to the beginning of the reserved section, *EndPos to
@@ -1133,9 +1311,9 @@ XLogInsertRecord(XLogRecData *rdata, XLogRecPtr fpw_lsn)
  * used to set the xl_prev of this record.
  *
  * This is the performance critical part of XLogInsert that must be serialized
- * across backends. The rest can happen mostly in parallel. Try to keep this
- * section as short as possible, insertpos_lck can be heavily contended on a
- * busy system.
+ * across backends. The rest can happen mostly in parallel. The serialization
+ * is done by a single atomic fetch-and-add, so there is no lock for
+ * concurrent inserters to queue up on.
  *
  * NB: The space calculation here must match the code in CopyXLogRecordToWAL,
  * where we actually copy the record to the reserved space.
@@ -1155,24 +1333,24 @@ ReserveXLogInsertLocation(int size, XLogRecPtr *StartPos, XLogRecPtr *EndPos,
 	Assert(size > SizeOfXLogRecord);
 
 	/*
-	 * The duration the spinlock needs to be held is minimized by minimizing
-	 * the calculations that have to be done while holding the lock. The
-	 * current tip of reserved WAL is kept in CurrBytePos, as a byte position
-	 * that only counts "usable" bytes in WAL, that is, it excludes all WAL
-	 * page headers. The mapping between "usable" byte positions and physical
-	 * positions (XLogRecPtrs) can be done outside the locked region, and
-	 * because the usable byte position doesn't include any headers, reserving
-	 * X bytes from WAL is almost as simple as "CurrBytePos += X".
+	 * The current tip of reserved WAL is kept in CurrBytePos, as a byte
+	 * position that only counts "usable" bytes in WAL, that is, it excludes
+	 * all WAL page headers. The mapping between "usable" byte positions and
+	 * physical positions (XLogRecPtrs) can be done afterwards, and because
+	 * the usable byte position doesn't include any headers, reserving X bytes
+	 * from WAL is just "CurrBytePos += X".
 	 */
-	SpinLockAcquire(&Insert->insertpos_lck);
-
-	startbytepos = Insert->CurrBytePos;
+	startbytepos = pg_atomic_fetch_add_u64(&Insert->CurrBytePos, size);
 	endbytepos = startbytepos + size;
-	prevbytepos = Insert->PrevBytePos;
-	Insert->CurrBytePos = endbytepos;
-	Insert->PrevBytePos = startbytepos;
 
-	SpinLockRelease(&Insert->insertpos_lck);
+	/*
+	 * The fetch-and-add can't also tell us where the previous record starts,
+	 * so get that from the prev-link its inserter left behind.  Publish our
+	 * own link first, so that our successor doesn't have to wait for us
+	 * while we wait for our predecessor.
+	 */
+	XLogPublishPrevLink(endbytepos, startbytepos);
+	prevbytepos = XLogGetPrevLink(startbytepos, true);
 
 	*StartPos = XLogBytePosToRecPtr(startbytepos);
 	*EndPos = XLogBytePosToEndRecPtr(endbytepos);
@@ -1208,25 +1386,22 @@ ReserveXLogSwitch(XLogRecPtr *StartPos, XLogRecPtr *EndPos, XLogRecPtr *PrevPtr)
 	uint32		segleft;
 
 	/*
-	 * These calculations are a bit heavy-weight to be done while holding a
-	 * spinlock, but since we're holding all the WAL insertion locks, there
-	 * are no other inserters competing for it. GetXLogInsertRecPtr() does
-	 * compete for it, but that's not called very frequently.
+	 * Since we're holding all the WAL insertion locks, there are no other
+	 * inserters that could advance CurrBytePos concurrently, so we can do
+	 * the calculations at leisure and then simply store the new value.
 	 */
-	SpinLockAcquire(&Insert->insertpos_lck);
+	Assert(holdingAllLocks);
 
-	startbytepos = Insert->CurrBytePos;
+	startbytepos = pg_atomic_read_u64(&Insert->CurrBytePos);
 
 	ptr = XLogBytePosToEndRecPtr(startbytepos);
 	if (ptr % XLOG_SEG_SIZE == 0)
 	{
-		SpinLockRelease(&Insert->insertpos_lck);
 		*EndPos = *StartPos = ptr;
 		return false;
 	}
 
 	endbytepos = startbytepos + size;
-	prevbytepos = Insert->PrevBytePos;
 
 	*StartPos = XLogBytePosToRecPtr(startbytepos);
 	*EndPos = XLogBytePosToEndRecPtr(endbytepos);
@@ -1238,10 +1413,10 @@ ReserveXLogSwitch(XLogRecPtr *StartPos, XLogRecPtr *EndPos, XLogRecPtr *PrevPtr)
 		*EndPos += segleft;
 		endbytepos = XLogRecPtrToBytePos(*EndPos);
 	}
-	Insert->CurrBytePos = endbytepos;
-	Insert->PrevBytePos = startbytepos;
+	pg_atomic_write_u64(&Insert->CurrBytePos, endbytepos);
 
-	SpinLockRelease(&Insert->insertpos_lck);
+	XLogPublishPrevLink(endbytepos, startbytepos);
+	prevbytepos = XLogGetPrevLink(startbytepos, true);
 
 	*PrevPtr = XLogBytePosToRecPtr(prevbytepos);
 
@@ -1400,7 +1575,7 @@ WALInsertLockAcquire(void)
 	static int	lockToTry = -1;
 
 	if (lockToTry == -1)
-		lockToTry = MyProc->pgprocno % NUM_XLOGINSERT_LOCKS;
+		lockToTry = MyProc->pgprocno % wal_insert_locks;
 	MyLockNo = lockToTry;
 
 	/*
@@ -1420,7 +1595,7 @@ WALInsertLockAcquire(void)
 		 * than locks, it still helps to distribute the inserters evenly
 		 * across the locks.
 		 */
-		lockToTry = (lockToTry + 1) % NUM_XLOGINSERT_LOCKS;
+		lockToTry = (lockToTry + 1) % wal_insert_locks;
 	}
 }
 
@@ -1439,7 +1614,7 @@ WALInsertLockAcquireExclusive(void)
 	 * than any real XLogRecPtr value, to make sure that no-one blocks waiting
 	 * on those.
 	 */
-	for (i = 0; i < NUM_XLOGINSERT_LOCKS - 1; i++)
+	for (i = 0; i < wal_insert_locks - 1; i++)
 	{
 		LWLockAcquireWithVar(&WALInsertLocks[i].l.lock,
 							 &WALInsertLocks[i].l.insertingAt,
@@ -1462,7 +1637,7 @@ WALInsertLockRelease(void)
 	{
 		int			i;
 
-		for (i = 0; i < NUM_XLOGINSERT_LOCKS; i++)
+		for (i = 0; i < wal_insert_locks; i++)
 			LWLockRelease(&WALInsertLocks[i].l.lock);
 
 		holdingAllLocks = false;
@@ -1486,8 +1661,8 @@ WALInsertLockUpdateInsertingAt(XLogRecPtr insertingAt)
 		 * We use the last lock to mark our actual position, see comments in
 		 * WALInsertLockAcquireExclusive.
 		 */
-		LWLockUpdateVar(&WALInsertLocks[NUM_XLOGINSERT_LOCKS - 1].l.lock,
-					 &WALInsertLocks[NUM_XLOGINSERT_LOCKS - 1].l.insertingAt,
+		LWLockUpdateVar(&WALInsertLocks[wal_insert_locks - 1].l.lock,
+					 &WALInsertLocks[wal_insert_locks - 1].l.insertingAt,
 						insertingAt);
 	}
 	else
@@ -1516,16 +1691,28 @@ WaitXLogInsertionsToFinish(XLogRecPtr upto)
 	uint64		bytepos;
 	XLogRecPtr	reservedUpto;
 	XLogRecPtr	finishedUpto;
+	uint64		expected;
 	XLogCtlInsert *Insert = &XLogCtl->Insert;
 	int			i;
 
 	if (MyProc == NULL)
 		elog(PANIC, "cannot wait without a PGPROC structure");
 
+	/*
+	 * If an earlier call already established that everything up to 'upto'
+	 * has been inserted, we're done, without having to look at any of the
+	 * insertion locks.  This is the common case when many backends flush at
+	 * about the same time, as followers in a group commit do.
+	 */
+	finishedUpto = pg_atomic_read_u64(&XLogCtl->insertsFinishedUpto);
+	if (upto <= finishedUpto)
+	{
+		pg_read_barrier();
+		return finishedUpto;
+	}
+
 	/* Read the current insert position */
-	SpinLockAcquire(&Insert->insertpos_lck);
-	bytepos = Insert->CurrBytePos;
-	SpinLockRelease(&Insert->insertpos_lck);
+	bytepos = pg_atomic_read_u64(&Insert->CurrBytePos);
 	reservedUpto = XLogBytePosToEndRecPtr(bytepos);
 
 	/*
@@ -1554,7 +1741,7 @@ WaitXLogInsertionsToFinish(XLogRecPtr upto)
 	 * out for any insertion that's still in progress.
 	 */
 	finishedUpto = reservedUpto;
-	for (i = 0; i < NUM_XLOGINSERT_LOCKS; i++)
+	for (i = 0; i < wal_insert_locks; i++)
 	{
 		XLogRecPtr	insertingat = InvalidXLogRecPtr;
 
@@ -1590,6 +1777,19 @@ WaitXLogInsertionsToFinish(XLogRecPtr upto)
 		if (insertingat != InvalidXLogRecPtr && insertingat < finishedUpto)
 			finishedUpto = insertingat;
 	}
+
+	/*
+	 * Advertise the new horizon for the benefit of later callers, unless
+	 * someone else has already advanced it further.
+	 */
+	expected = pg_atomic_read_u64(&XLogCtl->insertsFinishedUpto);
+	while (expected < finishedUpto)
+	{
+		if (pg_atomic_compare_exchange_u64(&XLogCtl->insertsFinishedUpto,
+										   &expected, finishedUpto))
+			break;
+	}
+
 	return finishedUpto;
 }
 
@@ -1921,6 +2121,14 @@ AdvanceXLInsertBuffer(XLogRecPtr upto, bool opportunistic)
 
 		NewPage = (XLogPageHeader) (XLogCtl->pages + nextidx * (Size) XLOG_BLCKSZ);
 
+		/*
+		 * Mark the buffer as not holding any page while we reinitialize it,
+		 * so that XLogReadFromBuffers() copying the old page concurrently
+		 * notices that the contents changed underneath it.
+		 */
+		*((volatile XLogRecPtr *) &XLogCtl->xlblocks[nextidx]) = InvalidXLogRecPtr;
+		pg_write_barrier();
+
 		/*
 		 * Be sure to re-zero the buffer so that bytes beyond what we've
 		 * written will look like zeroes and not valid XLOG records...
@@ -2254,7 +2462,9 @@ XLogWrite(XLogwrtRqst WriteRqst, bool flexible)
 			do
 			{
 				errno = 0;
+				pgstat_report_wait_start(WAIT_EVENT_WAL_WRITE);
 				written = write(openLogFile, from, nleft);
+				pgstat_report_wait_end();
 				if (written <= 0)
 				{
 					if (errno == EINTR)
@@ -2533,6 +2743,40 @@ UpdateMinRecoveryPoint(XLogRecPtr lsn, bool force)
 	LWLockRelease(ControlFileLock);
 }
 
+/*
+ * Weight of the newest sample in the moving averages kept for the adaptive
+ * commit_delay, and the longest delay it chooses (the maximum commit_delay).
+ */
+#define COMMIT_DELAY_SMOOTHING	0.1
+#define MAX_COMMIT_DELAY		100000
+
+/*
+ * Compute the adaptive commit_delay, in microseconds.  Caller must hold
+ * WALWriteLock.
+ *
+ * A backend that requests a flush while another one is being performed has
+ * to wait for half of the flush time on average, before it can start its
+ * own.  Delaying the flush for that long lets such backends join the group
+ * instead, without making anyone wait much longer than they otherwise
+ * would; but that only pays off if we expect another request to arrive in
+ * that time.  When requests are further apart, we flush right away.
+ */
+static int
+AdaptiveCommitDelay(void)
+{
+	double		interval;
+	double		delay;
+
+	SpinLockAcquire(&XLogCtl->info_lck);
+	interval = XLogCtl->avgFlushRequestInterval;
+	SpinLockRelease(&XLogCtl->info_lck);
+
+	delay = XLogCtl->avgFlushTime / 2;
+	if (delay < interval)
+		return 0;
+	return (int) Min(delay, MAX_COMMIT_DELAY);
+}
+
 /*
  * Ensure that all XLOG data through the given position is flushed to disk.
  *
@@ -2544,6 +2788,8 @@ XLogFlush(XLogRecPtr record)
 {
 	XLogRecPtr	WriteRqstPtr;
 	XLogwrtRqst WriteRqst;
+	bool		adaptive = (CommitDelay < 0 && enableFsync);
+	TimestampTz requestTime = 0;
 
 	/*
 	 * During REDO, we are reading not writing WAL.  Therefore, instead of
@@ -2583,6 +2829,10 @@ XLogFlush(XLogRecPtr record)
 	/* initialize to given target; may increase below */
 	WriteRqstPtr = record;
 
+	/* for the adaptive commit_delay, take note of the request's arrival */
+	if (adaptive)
+		requestTime = GetCurrentTimestamp();
+
 	/*
 	 * Now wait until we get the write lock, or someone else does the flush
 	 * for us.
@@ -2590,12 +2840,23 @@ XLogFlush(XLogRecPtr record)
 	for (;;)
 	{
 		XLogRecPtr	insertpos;
+		int			commitDelay;
 
 		/* read LogwrtResult and update local state */
 		SpinLockAcquire(&XLogCtl->info_lck);
 		if (WriteRqstPtr < XLogCtl->LogwrtRqst.Write)
 			WriteRqstPtr = XLogCtl->LogwrtRqst.Write;
 		LogwrtResult = XLogCtl->LogwrtResult;
+		if (requestTime != 0)
+		{
+			if (XLogCtl->lastFlushRequest != 0 &&
+				requestTime > XLogCtl->lastFlushRequest)
+				XLogCtl->avgFlushRequestInterval +=
+					((double) (requestTime - XLogCtl->lastFlushRequest) -
+					 XLogCtl->avgFlushRequestInterval) * COMMIT_DELAY_SMOOTHING;
+			XLogCtl->lastFlushRequest = requestTime;
+			requestTime = 0;
+		}
 		SpinLockRelease(&XLogCtl->info_lck);
 
 		/* done already? */
@@ -2641,11 +2902,20 @@ XLogFlush(XLogRecPtr record)
 		 *
 		 * We do not sleep if enableFsync is not turned on, nor if there are
 		 * fewer than CommitSiblings other backends with active transactions.
+		 * With the adaptive delay, the rate of flush requests decides
+		 * instead.
 		 */
-		if (CommitDelay > 0 && enableFsync &&
-			MinimumActiveBackends(CommitSiblings))
+		if (adaptive)
+			commitDelay = AdaptiveCommitDelay();
+		else if (CommitDelay > 0 && enableFsync &&
+				 MinimumActiveBackends(CommitSiblings))
+			commitDelay = CommitDelay;
+		else
+			commitDelay = 0;
+
+		if (commitDelay > 0)
 		{
-			pg_usleep(CommitDelay);
+			pg_usleep(commitDelay);
 
 			/*
 			 * Re-check how far we can now flush the WAL. It's generally not
@@ -2664,7 +2934,22 @@ XLogFlush(XLogRecPtr record)
 		WriteRqst.Write = insertpos;
 		WriteRqst.Flush = insertpos;
 
-		XLogWrite(WriteRqst, false);
+		if (adaptive)
+		{
+			instr_time	flush_start,
+						flush_time;
+
+			INSTR_TIME_SET_CURRENT(flush_start);
+			XLogWrite(WriteRqst, false);
+			INSTR_TIME_SET_CURRENT(flush_time);
+			INSTR_TIME_SUBTRACT(flush_time, flush_start);
+
+			XLogCtl->avgFlushTime +=
+				((double) INSTR_TIME_GET_MICROSEC(flush_time) -
+				 XLogCtl->avgFlushTime) * COMMIT_DELAY_SMOOTHING;
+		}
+		else
+			XLogWrite(WriteRqst, false);
 
 		LWLockRelease(WALWriteLock);
 		/* done */
@@ -2741,6 +3026,20 @@ XLogBackgroundFlush(void)
 	/* back off to last completed page boundary */
 	WriteRqstPtr -= WriteRqstPtr % XLOG_BLCKSZ;
 
+	/*
+	 * If we're past a unit of wal_writer_flush_after that hasn't been
+	 * flushed, back off further to its end, so that we write and flush
+	 * whole, aligned units while WAL is being generated faster than that.
+	 */
+	if (WalWriterFlushAfter > 0)
+	{
+		uint64		unit = (uint64) WalWriterFlushAfter * XLOG_BLCKSZ;
+		XLogRecPtr	unitEnd = WriteRqstPtr - WriteRqstPtr % unit;
+
+		if (unitEnd > LogwrtResult.Flush)
+			WriteRqstPtr = unitEnd;
+	}
+
 	/* if we have already flushed that far, consider async commit records */
 	if (WriteRqstPtr <= LogwrtResult.Flush)
 	{
@@ -4540,6 +4839,21 @@ check_wal_buffers(int *newval, void **extra, GucSource source)
 	return true;
 }
 
+/*
+ * Number of entries in the prev-link table, see XLogPublishPrevLink().
+ * Must be a power of 2.
+ */
+static int
+XLogPrevLinkCount(void)
+{
+	int			nlinks = 16;
+
+	while (nlinks < 4 * (wal_insert_locks + 1))
+		nlinks <<= 1;
+
+	return nlinks;
+}
+
 /*
  * Initialization of shared memory for XLOG
  */
@@ -4567,7 +4881,9 @@ XLOGShmemSize(void)
 	size = sizeof(XLogCtlData);
 
 	/* WAL insertion locks, plus alignment */
-	size = add_size(size, mul_size(sizeof(WALInsertLockPadded), NUM_XLOGINSERT_LOCKS + 1));
+	size = add_size(size, mul_size(sizeof(WALInsertLockPadded), wal_insert_locks + 1));
+	/* prev-link table */
+	size = add_size(size, mul_size(sizeof(XLogPrevLinkPadded), XLogPrevLinkCount()));
 	/* xlblocks array */
 	size = add_size(size, mul_size(sizeof(XLogRecPtr), XLOGbuffers));
 	/* extra alignment padding for XLOG I/O buffers */
@@ -4644,7 +4960,7 @@ XLOGShmemInit(void)
 		((uintptr_t) allocptr) %sizeof(WALInsertLockPadded);
 	WALInsertLocks = XLogCtl->Insert.WALInsertLocks =
 		(WALInsertLockPadded *) allocptr;
-	allocptr += sizeof(WALInsertLockPadded) * NUM_XLOGINSERT_LOCKS;
+	allocptr += sizeof(WALInsertLockPadded) * wal_insert_locks;
 
 	XLogCtl->Insert.WALInsertLockTrancheId = LWLockNewTrancheId();
 
@@ -4653,13 +4969,24 @@ XLOGShmemInit(void)
 	XLogCtl->Insert.WALInsertLockTranche.array_stride = sizeof(WALInsertLockPadded);
 
 	LWLockRegisterTranche(XLogCtl->Insert.WALInsertLockTrancheId, &XLogCtl->Insert.WALInsertLockTranche);
-	for (i = 0; i < NUM_XLOGINSERT_LOCKS; i++)
+	for (i = 0; i < wal_insert_locks; i++)
 	{
 		LWLockInitialize(&WALInsertLocks[i].l.lock,
 						 XLogCtl->Insert.WALInsertLockTrancheId);
 		WALInsertLocks[i].l.insertingAt = InvalidXLogRecPtr;
 	}
 
+	/* The prev-link table follows, still aligned to a cache line */
+	XLogCtl->Insert.PrevLinks = (XLogPrevLinkPadded *) allocptr;
+	XLogCtl->Insert.numPrevLinks = XLogPrevLinkCount();
+	allocptr += sizeof(XLogPrevLinkPadded) * XLogCtl->Insert.numPrevLinks;
+	for (i = 0; i < XLogCtl->Insert.numPrevLinks; i++)
+	{
+		pg_atomic_init_u64(&XLogCtl->Insert.PrevLinks[i].l.endpos,
+						   XLOG_PREVLINK_FREE);
+		XLogCtl->Insert.PrevLinks[i].l.startpos = 0;
+	}
+
 	/*
 	 * Align the start of the page buffers to a full xlog block size boundary.
 	 * This simplifies some calculations in XLOG insertion. It is also
@@ -4678,7 +5005,8 @@ XLOGShmemInit(void)
 	XLogCtl->SharedHotStandbyActive = false;
 	XLogCtl->WalWriterSleeping = false;
 
-	SpinLockInit(&XLogCtl->Insert.insertpos_lck);
+	pg_atomic_init_u64(&XLogCtl->Insert.CurrBytePos, 0);
+	pg_atomic_init_u64(&XLogCtl->insertsFinishedUpto, InvalidXLogRecPtr);
 	SpinLockInit(&XLogCtl->info_lck);
 	SpinLockInit(&XLogCtl->ulsn_lck);
 	InitSharedLatch(&XLogCtl->recoveryWakeupLatch);
@@ -5079,6 +5407,26 @@ readRecoveryCommandFile(void)
 					(errmsg_internal("trigger_file = '%s'",
 									 TriggerFile)));
 		}
+		else if (strcmp(item->name, "restore_prefetch") == 0)
+		{
+			if (!parse_int(item->value, &recoveryRestorePrefetch, 0, NULL) ||
+				recoveryRestorePrefetch < 0)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("parameter \"%s\" requires a non-negative integer value",
+								"restore_prefetch")));
+#ifdef WIN32
+			if (recoveryRestorePrefetch > 0)
+			{
+				ereport(WARNING,
+						(errmsg("parameter \"%s\" is not supported on this platform",
+								"restore_prefetch")));
+				recoveryRestorePrefetch = 0;
+			}
+#endif
+			ereport(DEBUG2,
+					(errmsg_internal("restore_prefetch = '%s'", item->value)));
+		}
 		else if (strcmp(item->name, "recovery_min_apply_delay") == 0)
 		{
 			const char *hintmsg;
@@ -5247,6 +5595,9 @@ exitArchiveRecovery(TimeLineID endTLI, XLogRecPtr endOfLog)
 	XLogFileName(xlogfname, ThisTimeLineID, startLogSegNo);
 	XLogArchiveCleanup(xlogfname);
 
+	/* Stop fetching segments ahead, and remove those already fetched */
+	RestorePrefetchCleanup();
+
 	/*
 	 * Since there might be a partial WAL segment named RECOVERYXLOG, get rid
 	 * of it.
@@ -6653,6 +7004,9 @@ StartupXLOG(void)
 		{
 			ErrorContextCallback errcallback;
 			TimestampTz xtime;
+			XLogPrefetcher *prefetcher;
+			XLogRecPtr	dispatchedEndRecPtr = InvalidXLogRecPtr;
+			TimeLineID	dispatchedTLI = 0;
 
 			InRedo = true;
 
@@ -6660,12 +7014,15 @@ StartupXLOG(void)
 					(errmsg("redo starts at %X/%X",
 						 (uint32) (ReadRecPtr >> 32), (uint32) ReadRecPtr)));
 
+			prefetcher = XLogPrefetcherAllocate();
+
 			/*
 			 * main redo apply loop
 			 */
 			do
 			{
 				bool		switchedTLI = false;
+				bool		dispatched;
 
 #ifdef WAL_DEBUG
 				if (XLOG_DEBUG ||
@@ -6689,6 +7046,13 @@ StartupXLOG(void)
 				/* Handle interrupt signals of startup process */
 				HandleStartupProcInterrupts();
 
+				/*
+				 * Ask the kernel for the blocks that the records ahead of
+				 * this one will need, so that the reads overlap with replay.
+				 */
+				XLogPrefetcherReadAhead(prefetcher, xlogreader->EndRecPtr,
+										ThisTimeLineID);
+
 				/*
 				 * Pause WAL replay, if requested by a hot-standby session via
 				 * SetRecoveryPause().
@@ -6813,20 +7177,33 @@ StartupXLOG(void)
 					TransactionIdIsValid(record->xl_xid))
 					RecordKnownAssignedTransactionIds(record->xl_xid);
 
-				/* Now apply the WAL record itself */
-				RmgrTable[record->xl_rmid].rm_redo(xlogreader);
+				/* Now apply the WAL record itself, or let a redo worker do it */
+				dispatched = RedoWorkerDispatch(xlogreader);
+				if (!dispatched)
+					RmgrTable[record->xl_rmid].rm_redo(xlogreader);
 
 				/* Pop the error context stack */
 				error_context_stack = errcallback.previous;
 
 				/*
 				 * Update lastReplayedEndRecPtr after this record has been
-				 * successfully replayed.
+				 * successfully replayed.  A record handed to a redo worker
+				 * only counts as replayed once the workers have caught up,
+				 * which RedoWorkerDispatch waits for before returning false.
 				 */
-				SpinLockAcquire(&XLogCtl->info_lck);
-				XLogCtl->lastReplayedEndRecPtr = EndRecPtr;
-				XLogCtl->lastReplayedTLI = ThisTimeLineID;
-				SpinLockRelease(&XLogCtl->info_lck);
+				if (dispatched)
+				{
+					dispatchedEndRecPtr = EndRecPtr;
+					dispatchedTLI = ThisTimeLineID;
+				}
+				else
+				{
+					dispatchedEndRecPtr = InvalidXLogRecPtr;
+					SpinLockAcquire(&XLogCtl->info_lck);
+					XLogCtl->lastReplayedEndRecPtr = EndRecPtr;
+					XLogCtl->lastReplayedTLI = ThisTimeLineID;
+					SpinLockRelease(&XLogCtl->info_lck);
+				}
 
 				/* Remember this record as the last-applied one */
 				LastRec = ReadRecPtr;
@@ -6867,6 +7244,18 @@ StartupXLOG(void)
 			 * end of main redo apply loop
 			 */
 
+			XLogPrefetcherFree(prefetcher);
+
+			/* Let the redo workers finish, and account for their work */
+			RedoWorkersShutdown();
+			if (!XLogRecPtrIsInvalid(dispatchedEndRecPtr))
+			{
+				SpinLockAcquire(&XLogCtl->info_lck);
+				XLogCtl->lastReplayedEndRecPtr = dispatchedEndRecPtr;
+				XLogCtl->lastReplayedTLI = dispatchedTLI;
+				SpinLockRelease(&XLogCtl->info_lck);
+			}
+
 			if (reachedStopPoint)
 			{
 				if (!reachedConsistency)
@@ -7081,8 +7470,10 @@ StartupXLOG(void)
 	 * previous incarnation.
 	 */
 	Insert = &XLogCtl->Insert;
-	Insert->PrevBytePos = XLogRecPtrToBytePos(LastRec);
-	Insert->CurrBytePos = XLogRecPtrToBytePos(EndOfLog);
+	pg_atomic_write_u64(&Insert->CurrBytePos, XLogRecPtrToBytePos(EndOfLog));
+	XLogPublishPrevLink(XLogRecPtrToBytePos(EndOfLog),
+						XLogRecPtrToBytePos(LastRec));
+	pg_atomic_write_u64(&XLogCtl->insertsFinishedUpto, EndOfLog);
 
 	/*
 	 * Tricky point here: readBuf contains the *last* block that the LastRec
@@ -7303,6 +7694,7 @@ StartupXLOG(void)
 	LWLockAcquire(ProcArrayLock, LW_EXCLUSIVE);
 	ShmemVariableCache->latestCompletedXid = ShmemVariableCache->nextXid;
 	TransactionIdRetreat(ShmemVariableCache->latestCompletedXid);
+	ShmemVariableCache->xactCompletionCount = 1;
 	LWLockRelease(ProcArrayLock);
 
 	/*
@@ -7842,6 +8234,61 @@ GetFlushRecPtr(void)
 	return recptr;
 }
 
+/*
+ * XLogReadFromBuffers -- Copy WAL starting at startptr from the WAL buffers
+ *
+ * Copies as much of the 'count' bytes as are still present in the WAL
+ * buffers into 'buf', stopping at the first page that has already been
+ * replaced, and returns the number of bytes copied.  This lets walsenders
+ * serving a primary send recent WAL without reading it back from the
+ * segment files.  The caller must make sure that the WAL has been flushed,
+ * and must not use this during recovery, when the buffers are not in use.
+ *
+ * No lock is taken; instead each page is verified to still be mapped to
+ * the same buffer after copying it, see AdvanceXLInsertBuffer().
+ */
+Size
+XLogReadFromBuffers(char *buf, XLogRecPtr startptr, Size count)
+{
+	XLogRecPtr	recptr = startptr;
+	Size		nbytes = 0;
+
+	while (nbytes < count)
+	{
+		int			idx = XLogRecPtrToBufIdx(recptr);
+		XLogRecPtr	expectedEndPtr;
+		uint32		offset;
+		Size		len;
+		char	   *page;
+
+		expectedEndPtr = recptr + (XLOG_BLCKSZ - recptr % XLOG_BLCKSZ);
+		offset = recptr % XLOG_BLCKSZ;
+		len = Min(count - nbytes, XLOG_BLCKSZ - offset);
+
+		if (*((volatile XLogRecPtr *) &XLogCtl->xlblocks[idx]) != expectedEndPtr)
+			break;
+
+		/* Don't read the page contents before the check above */
+		pg_read_barrier();
+
+		page = XLogCtl->pages + idx * (Size) XLOG_BLCKSZ;
+		memcpy(buf + nbytes, page + offset, len);
+
+		/*
+		 * If the buffer was reinitialized while we copied it, the copy may be
+		 * garbage; forget it and let the caller read the page from disk.
+		 */
+		pg_read_barrier();
+		if (*((volatile XLogRecPtr *) &XLogCtl->xlblocks[idx]) != expectedEndPtr)
+			break;
+
+		nbytes += len;
+		recptr += len;
+	}
+
+	return nbytes;
+}
+
 /*
  * Get the time of the last xlog segment switch
  */
@@ -8107,6 +8554,7 @@ CreateCheckPoint(int flags)
 	XLogRecPtr	PriorRedoPtr;
 	XLogRecPtr	curInsert;
 	XLogRecPtr	prevPtr;
+	uint64		curbytepos;
 	VirtualTransactionId *vxids;
 	int			nvxids;
 
@@ -8191,8 +8639,9 @@ CreateCheckPoint(int flags)
 	 * determine the checkpoint REDO pointer.
 	 */
 	WALInsertLockAcquireExclusive();
-	curInsert = XLogBytePosToRecPtr(Insert->CurrBytePos);
-	prevPtr = XLogBytePosToRecPtr(Insert->PrevBytePos);
+	curbytepos = pg_atomic_read_u64(&Insert->CurrBytePos);
+	curInsert = XLogBytePosToRecPtr(curbytepos);
+	prevPtr = XLogBytePosToRecPtr(XLogGetPrevLink(curbytepos, false));
 
 	/*
 	 * If this isn't a shutdown or forced checkpoint, and we have not inserted
@@ -9665,6 +10114,7 @@ assign_xlog_sync_method(int new_sync_method, void *extra)
 void
 issue_xlog_fsync(int fd, XLogSegNo segno)
 {
+	pgstat_report_wait_start(WAIT_EVENT_WAL_SYNC);
 	switch (sync_method)
 	{
 		case SYNC_METHOD_FSYNC:
@@ -9700,6 +10150,7 @@ issue_xlog_fsync(int fd, XLogSegNo segno)
 			elog(PANIC, "unrecognized wal_sync_method: %d", sync_method);
 			break;
 	}
+	pgstat_report_wait_end();
 }
 
 /*
@@ -10616,9 +11067,7 @@ GetXLogInsertRecPtr(void)
 	XLogCtlInsert *Insert = &XLogCtl->Insert;
 	uint64		current_bytepos;
 
-	SpinLockAcquire(&Insert->insertpos_lck);
-	current_bytepos = Insert->CurrBytePos;
-	SpinLockRelease(&Insert->insertpos_lck);
+	current_bytepos = pg_atomic_read_u64(&Insert->CurrBytePos);
 
 	return XLogBytePosToRecPtr(current_bytepos);
 }
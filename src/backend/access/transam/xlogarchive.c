@@ -22,13 +22,44 @@
 
 #include "access/xlog.h"
 #include "access/xlog_internal.h"
+#include "libpq/pqsignal.h"
 #include "miscadmin.h"
+#include "postmaster/fork_process.h"
 #include "postmaster/startup.h"
 #include "replication/walsender.h"
 #include "storage/fd.h"
 #include "storage/ipc.h"
 #include "storage/lwlock.h"
 #include "storage/pmsignal.h"
+#include "utils/memutils.h"
+
+/*
+ * Segments being fetched ahead of recovery by restore_prefetch, each by a
+ * restore_command child process of the startup process into a file named
+ * RECOVERYPREFETCH.<segment name> in pg_xlog.
+ */
+typedef struct RestorePrefetchSlot
+{
+	bool		used;			/* is this slot in use? */
+	pid_t		pid;			/* restore_command process, 0 if finished */
+	bool		ok;				/* did it succeed?  Valid if pid is 0 */
+	TimeLineID	tli;
+	XLogSegNo	segno;
+} RestorePrefetchSlot;
+
+#define RESTORE_PREFETCH_PREFIX		"RECOVERYPREFETCH."
+
+static RestorePrefetchSlot *prefetchSlots = NULL;
+
+static void BuildRestoreCommand(char *xlogRestoreCmd, const char *xlogpath,
+					const char *xlogfname, const char *lastRestartPointFname);
+#ifndef WIN32
+static bool RestorePrefetchTake(const char *xlogfname, const char *xlogpath);
+static void RestorePrefetchSchedule(const char *xlogfname,
+						const char *lastRestartPointFname);
+static void RestorePrefetchReap(RestorePrefetchSlot *slot, bool wait);
+static void RestorePrefetchAtExit(int code, Datum arg);
+#endif
 
 /*
  * Attempt to retrieve the specified file from off-line archival storage.
@@ -56,11 +87,9 @@ RestoreArchivedFile(char *path, const char *xlogfname,
 	char		xlogpath[MAXPGPATH];
 	char		xlogRestoreCmd[MAXPGPATH];
 	char		lastRestartPointFname[MAXPGPATH];
-	char	   *dp;
-	char	   *endp;
-	const char *sp;
 	int			rc;
 	bool		signaled;
+	bool		prefetched = false;
 	struct stat stat_buf;
 	XLogSegNo	restartSegNo;
 	XLogRecPtr	restartRedoPtr;
@@ -143,74 +172,46 @@ RestoreArchivedFile(char *path, const char *xlogfname,
 	else
 		XLogFileName(lastRestartPointFname, 0, 0L);
 
+#ifndef WIN32
+
 	/*
-	 * construct the command to be executed
+	 * If requested, fetch the following segments in the background while we
+	 * process this one, and use this one if it has been fetched already.
 	 */
-	dp = xlogRestoreCmd;
-	endp = xlogRestoreCmd + MAXPGPATH - 1;
-	*endp = '\0';
-
-	for (sp = recoveryRestoreCommand; *sp; sp++)
+	if (recoveryRestorePrefetch > 0 && expectedSize == XLogSegSize &&
+		IsXLogFileName(xlogfname))
 	{
-		if (*sp == '%')
-		{
-			switch (sp[1])
-			{
-				case 'p':
-					/* %p: relative path of target file */
-					sp++;
-					StrNCpy(dp, xlogpath, endp - dp);
-					make_native_path(dp);
-					dp += strlen(dp);
-					break;
-				case 'f':
-					/* %f: filename of desired file */
-					sp++;
-					StrNCpy(dp, xlogfname, endp - dp);
-					dp += strlen(dp);
-					break;
-				case 'r':
-					/* %r: filename of last restartpoint */
-					sp++;
-					StrNCpy(dp, lastRestartPointFname, endp - dp);
-					dp += strlen(dp);
-					break;
-				case '%':
-					/* convert %% to a single % */
-					sp++;
-					if (dp < endp)
-						*dp++ = *sp;
-					break;
-				default:
-					/* otherwise treat the % as not special */
-					if (dp < endp)
-						*dp++ = *sp;
-					break;
-			}
-		}
-		else
-		{
-			if (dp < endp)
-				*dp++ = *sp;
-		}
+		RestorePrefetchSchedule(xlogfname, lastRestartPointFname);
+		prefetched = RestorePrefetchTake(xlogfname, xlogpath);
 	}
-	*dp = '\0';
+#endif
 
-	ereport(DEBUG3,
-			(errmsg_internal("executing restore command \"%s\"",
-							 xlogRestoreCmd)));
+	if (prefetched)
+		rc = 0;
+	else
+	{
+		/*
+		 * construct the command to be executed
+		 */
+		BuildRestoreCommand(xlogRestoreCmd, xlogpath, xlogfname,
+							lastRestartPointFname);
 
-	/*
-	 * Check signals before restore command and reset afterwards.
-	 */
-	PreRestoreCommand();
+		ereport(DEBUG3,
+				(errmsg_internal("executing restore command \"%s\"",
+								 xlogRestoreCmd)));
 
-	/*
-	 * Copy xlog from archival storage to XLOGDIR
-	 */
-	rc = system(xlogRestoreCmd);
+		/*
+		 * Check signals before restore command and reset afterwards.
+		 */
+		PreRestoreCommand();
 
-	PostRestoreCommand();
+		/*
+		 * Copy xlog from archival storage to XLOGDIR
+		 */
+		rc = system(xlogRestoreCmd);
+
+		PostRestoreCommand();
+	}
 
 	if (rc == 0)
 	{
@@ -316,6 +317,331 @@ not_available:
 	return false;
 }
 
+/*
+ * Construct the restore_command to fetch xlogfname into xlogpath, in a
+ * buffer of MAXPGPATH bytes.
+ */
+static void
+BuildRestoreCommand(char *xlogRestoreCmd, const char *xlogpath,
+					const char *xlogfname, const char *lastRestartPointFname)
+{
+	char	   *dp;
+	char	   *endp;
+	const char *sp;
+
+	dp = xlogRestoreCmd;
+	endp = xlogRestoreCmd + MAXPGPATH - 1;
+	*endp = '\0';
+
+	for (sp = recoveryRestoreCommand; *sp; sp++)
+	{
+		if (*sp == '%')
+		{
+			switch (sp[1])
+			{
+				case 'p':
+					/* %p: relative path of target file */
+					sp++;
+					StrNCpy(dp, xlogpath, endp - dp);
+					make_native_path(dp);
+					dp += strlen(dp);
+					break;
+				case 'f':
+					/* %f: filename of desired file */
+					sp++;
+					StrNCpy(dp, xlogfname, endp - dp);
+					dp += strlen(dp);
+					break;
+				case 'r':
+					/* %r: filename of last restartpoint */
+					sp++;
+					StrNCpy(dp, lastRestartPointFname, endp - dp);
+					dp += strlen(dp);
+					break;
+				case '%':
+					/* convert %% to a single % */
+					sp++;
+					if (dp < endp)
+						*dp++ = *sp;
+					break;
+				default:
+					/* otherwise treat the % as not special */
+					if (dp < endp)
+						*dp++ = *sp;
+					break;
+			}
+		}
+		else
+		{
+			if (dp < endp)
+				*dp++ = *sp;
+		}
+	}
+	*dp = '\0';
+}
+
+#ifndef WIN32
+
+/*
+ * Look for a prefetched copy of segment xlogfname, waiting for its
+ * restore_command to finish if it's still running.  If it was fetched
+ * successfully, move it to xlogpath and return true.  Otherwise return
+ * false, so that the caller runs restore_command for it again and reports
+ * any failure as usual.
+ */
+static bool
+RestorePrefetchTake(const char *xlogfname, const char *xlogpath)
+{
+	TimeLineID	tli;
+	XLogSegNo	segno;
+	char		prefetchpath[MAXPGPATH];
+	bool		result = false;
+	int			i;
+
+	XLogFromFileName(xlogfname, &tli, &segno);
+
+	for (i = 0; i < recoveryRestorePrefetch; i++)
+	{
+		RestorePrefetchSlot *slot = &prefetchSlots[i];
+
+		if (!slot->used || slot->tli != tli || slot->segno != segno)
+			continue;
+
+		if (slot->pid != 0)
+		{
+			PreRestoreCommand();
+			RestorePrefetchReap(slot, true);
+			PostRestoreCommand();
+		}
+
+		snprintf(prefetchpath, MAXPGPATH,
+				 XLOGDIR "/" RESTORE_PREFETCH_PREFIX "%s", xlogfname);
+		if (slot->ok)
+		{
+			if (rename(prefetchpath, xlogpath) == 0)
+				result = true;
+			else if (errno != ENOENT)
+				ereport(FATAL,
+						(errcode_for_file_access(),
+						 errmsg("could not rename file \"%s\" to \"%s\": %m",
+								prefetchpath, xlogpath)));
+		}
+		else
+			unlink(prefetchpath);	/* ignore any error */
+
+		slot->used = false;
+		break;
+	}
+
+	return result;
+}
+
+/*
+ * Start restore_command for those of the restore_prefetch segments
+ * following xlogfname that aren't being fetched yet, and forget about
+ * finished prefetches that are no longer going to be needed.
+ */
+static void
+RestorePrefetchSchedule(const char *xlogfname,
+						const char *lastRestartPointFname)
+{
+	TimeLineID	tli;
+	XLogSegNo	segno;
+	XLogSegNo	nextsegno;
+	char		prefetchpath[MAXPGPATH];
+	char		prefetchfname[MAXFNAMELEN];
+	char		xlogRestoreCmd[MAXPGPATH];
+	int			i;
+
+	if (prefetchSlots == NULL)
+	{
+		DIR		   *xldir;
+		struct dirent *xlde;
+
+		prefetchSlots = (RestorePrefetchSlot *)
+			MemoryContextAllocZero(TopMemoryContext,
+						  recoveryRestorePrefetch * sizeof(RestorePrefetchSlot));
+		on_proc_exit(RestorePrefetchAtExit, 0);
+
+		/* Remove any files left over by a previous startup process */
+		xldir = AllocateDir(XLOGDIR);
+		while ((xlde = ReadDir(xldir, XLOGDIR)) != NULL)
+		{
+			if (strncmp(xlde->d_name, RESTORE_PREFETCH_PREFIX,
+						strlen(RESTORE_PREFETCH_PREFIX)) == 0)
+			{
+				snprintf(prefetchpath, MAXPGPATH, XLOGDIR "/%s", xlde->d_name);
+				unlink(prefetchpath);	/* ignore any error */
+			}
+		}
+		FreeDir(xldir);
+	}
+
+	XLogFromFileName(xlogfname, &tli, &segno);
+
+	/*
+	 * Collect finished processes, and drop the results of those that fetched
+	 * a segment we've gone past, or of another timeline.  Processes that are
+	 * still running keep their slot until they finish.
+	 */
+	for (i = 0; i < recoveryRestorePrefetch; i++)
+	{
+		RestorePrefetchSlot *slot = &prefetchSlots[i];
+
+		if (!slot->used)
+			continue;
+		if (slot->pid != 0)
+			RestorePrefetchReap(slot, false);
+		if (slot->pid == 0 &&
+			(slot->tli != tli || slot->segno < segno ||
+			 slot->segno > segno + recoveryRestorePrefetch))
+		{
+			XLogFileName(prefetchfname, slot->tli, slot->segno);
+			snprintf(prefetchpath, MAXPGPATH,
+					 XLOGDIR "/" RESTORE_PREFETCH_PREFIX "%s", prefetchfname);
+			unlink(prefetchpath);	/* ignore any error */
+			slot->used = false;
+		}
+	}
+
+	for (nextsegno = segno + 1;
+		 nextsegno <= segno + recoveryRestorePrefetch;
+		 nextsegno++)
+	{
+		RestorePrefetchSlot *freeslot = NULL;
+		pid_t		pid;
+
+		for (i = 0; i < recoveryRestorePrefetch; i++)
+		{
+			RestorePrefetchSlot *slot = &prefetchSlots[i];
+
+			if (!slot->used)
+			{
+				if (freeslot == NULL)
+					freeslot = slot;
+			}
+			else if (slot->tli == tli && slot->segno == nextsegno)
+				break;
+		}
+		if (i < recoveryRestorePrefetch)
+			continue;			/* already being fetched */
+		if (freeslot == NULL)
+			break;				/* all slots busy */
+
+		XLogFileName(prefetchfname, tli, nextsegno);
+		snprintf(prefetchpath, MAXPGPATH,
+				 XLOGDIR "/" RESTORE_PREFETCH_PREFIX "%s", prefetchfname);
+		unlink(prefetchpath);	/* ignore any error */
+
+		BuildRestoreCommand(xlogRestoreCmd, prefetchpath, prefetchfname,
+							lastRestartPointFname);
+
+		ereport(DEBUG3,
+				(errmsg_internal("executing restore command \"%s\" in background",
+								 xlogRestoreCmd)));
+
+		pid = fork_process();
+		if (pid == 0)
+		{
+			/* in child: run the command, as system() would */
+			pqsignal(SIGINT, SIG_DFL);
+			pqsignal(SIGPIPE, SIG_DFL);
+			execl("/bin/sh", "sh", "-c", xlogRestoreCmd, (char *) NULL);
+			_exit(127);
+		}
+		if (pid < 0)
+		{
+			ereport(LOG,
+					(errmsg("could not fork restore_command process: %m")));
+			break;
+		}
+
+		freeslot->used = true;
+		freeslot->pid = pid;
+		freeslot->ok = false;
+		freeslot->tli = tli;
+		freeslot->segno = nextsegno;
+	}
+}
+
+/*
+ * Check whether the restore_command process of a prefetch slot has exited,
+ * or wait for it to exit if 'wait' is true, and record its outcome.
+ */
+static void
+RestorePrefetchReap(RestorePrefetchSlot *slot, bool wait)
+{
+	pid_t		pid;
+	int			status;
+
+	do
+	{
+		pid = waitpid(slot->pid, &status, wait ? 0 : WNOHANG);
+	} while (pid < 0 && errno == EINTR);
+
+	if (pid == 0)
+		return;					/* still running */
+
+	slot->pid = 0;
+	slot->ok = (pid > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	if (pid > 0 && !slot->ok)
+	{
+		char		fname[MAXFNAMELEN];
+
+		XLogFileName(fname, slot->tli, slot->segno);
+		ereport(DEBUG2,
+				(errmsg("could not prefetch file \"%s\" from archive: %s",
+						fname, wait_result_to_str(status))));
+	}
+}
+
+/*
+ * Stop any prefetching restore_command processes and remove their files,
+ * at exit of the startup process.
+ */
+static void
+RestorePrefetchAtExit(int code, Datum arg)
+{
+	RestorePrefetchCleanup();
+}
+
+#endif   /* !WIN32 */
+
+/*
+ * Stop any restore_command processes started for restore_prefetch, and
+ * remove the files they fetched.  Called at the end of archive recovery.
+ */
+void
+RestorePrefetchCleanup(void)
+{
+#ifndef WIN32
+	char		prefetchfname[MAXFNAMELEN];
+	char		prefetchpath[MAXPGPATH];
+	int			i;
+
+	if (prefetchSlots == NULL)
+		return;
+
+	for (i = 0; i < recoveryRestorePrefetch; i++)
+	{
+		RestorePrefetchSlot *slot = &prefetchSlots[i];
+
+		if (!slot->used)
+			continue;
+		if (slot->pid != 0)
+		{
+			kill(slot->pid, SIGTERM);
+			RestorePrefetchReap(slot, true);
+		}
+		XLogFileName(prefetchfname, slot->tli, slot->segno);
+		snprintf(prefetchpath, MAXPGPATH,
+				 XLOGDIR "/" RESTORE_PREFETCH_PREFIX "%s", prefetchfname);
+		unlink(prefetchpath);	/* ignore any error */
+		slot->used = false;
+	}
+#endif
+}
+
 /*
  * Attempt to execute an external shell command during recovery.
  *
@@ -0,0 +1,446 @@
+/*-------------------------------------------------------------------------
+ *
+ * xlogprefetch.c
+ *		Prefetching support for recovery.
+ *
+ * During crash recovery and standby replay, every redo routine that
+ * touches a data block reads it synchronously, and on a cold buffer pool
+ * the startup process spends most of its time waiting for those reads
+ * one at a time.  To hide that latency, the startup process runs a second
+ * XLogReader a little ahead of the replay position, decodes the block
+ * references of the records it finds there, and issues smgrprefetch()
+ * hints for the blocks that are not yet in shared buffers.  By the time
+ * replay reaches the record, the kernel has hopefully brought the block
+ * into its page cache.
+ *
+ * The read-ahead reader reads WAL directly from the segment files in
+ * pg_xlog and never waits for WAL to arrive: whenever it cannot read or
+ * decode the next record, be it because we have reached the end of the
+ * WAL written so far, because the segment was restored from the archive
+ * into a temporary file, or because of a timeline switch, it simply
+ * stops and tries again once replay has made some progress.  Since the
+ * result only affects which blocks we hint to the kernel, no error seen
+ * here is ever reported.
+ *
+ * Blocks that the record carries a full-page image for, or that redo will
+ * initialize from scratch, are not prefetched, since replay doesn't need
+ * to read them.  Neither are blocks past the current end of the relation,
+ * nor blocks that were prefetched very recently.
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * src/backend/access/transam/xlogprefetch.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "access/htup_details.h"
+#include "access/xlog_internal.h"
+#include "access/xlogprefetch.h"
+#include "access/xlogreader.h"
+#include "catalog/pg_type.h"
+#include "funcapi.h"
+#include "port/atomics.h"
+#include "storage/bufmgr.h"
+#include "storage/fd.h"
+#include "storage/shmem.h"
+#include "storage/smgr.h"
+#include "utils/builtins.h"
+
+/* GUC variable */
+int			recovery_prefetch_distance = 256;
+
+/*
+ * Number of recently prefetched blocks we remember, to avoid issuing the
+ * same hint over and over when consecutive records touch the same block.
+ */
+#define XLOGPREFETCHER_RECENT_BLOCKS	64
+
+typedef struct XLogPrefetchRecentBlock
+{
+	RelFileNode rnode;
+	ForkNumber	forknum;
+	BlockNumber blkno;
+} XLogPrefetchRecentBlock;
+
+struct XLogPrefetcher
+{
+	/* Reader used to decode WAL ahead of replay */
+	XLogReaderState *reader;
+
+	/* Timeline and currently open segment of the page read callback */
+	TimeLineID	tli;
+	int			readFile;
+	XLogSegNo	readSegNo;
+
+	/*
+	 * If the reader failed to read or decode a record, we don't try again
+	 * until replay has advanced past stallReplayPtr.
+	 */
+	bool		stalled;
+	XLogRecPtr	stallReplayPtr;
+
+	/* Ring buffer of recently prefetched blocks */
+	XLogPrefetchRecentBlock recent[XLOGPREFETCHER_RECENT_BLOCKS];
+	int			nextRecent;
+};
+
+/*
+ * Counters exposed in the pg_stat_recovery_prefetch view.  They are only
+ * ever advanced by the startup process.
+ */
+typedef struct XLogPrefetchStats
+{
+	pg_atomic_uint64 prefetch;	/* prefetches issued */
+	pg_atomic_uint64 hit;		/* blocks already in shared buffers */
+	pg_atomic_uint64 skip_init; /* blocks with FPI or initialized by redo */
+	pg_atomic_uint64 skip_new;	/* blocks past the end of the relation */
+	pg_atomic_uint64 skip_rep;	/* blocks prefetched recently */
+	pg_atomic_uint32 distance;	/* current read-ahead distance, in bytes */
+} XLogPrefetchStats;
+
+static XLogPrefetchStats *Stats = NULL;
+
+static int XLogPrefetcherReadPage(XLogReaderState *xlogreader,
+					   XLogRecPtr targetPagePtr, int reqLen,
+					   XLogRecPtr targetRecPtr, char *readBuf,
+					   TimeLineID *pageTLI);
+static void XLogPrefetcherCloseSegment(XLogPrefetcher *prefetcher);
+static void XLogPrefetcherResync(XLogPrefetcher *prefetcher,
+					 XLogRecPtr replayEndPtr);
+static void XLogPrefetcherScanBlocks(XLogPrefetcher *prefetcher);
+static bool XLogPrefetcherIsRecent(XLogPrefetcher *prefetcher,
+					   RelFileNode rnode, ForkNumber forknum,
+					   BlockNumber blkno);
+
+/*
+ * Report shared-memory space needed by XLogPrefetchShmemInit.
+ */
+Size
+XLogPrefetchShmemSize(void)
+{
+	return sizeof(XLogPrefetchStats);
+}
+
+/*
+ * Initialize the shared-memory statistics counters.
+ */
+void
+XLogPrefetchShmemInit(void)
+{
+	bool		found;
+
+	Stats = (XLogPrefetchStats *)
+		ShmemInitStruct("XLog Prefetch Stats", sizeof(XLogPrefetchStats),
+						&found);
+	if (!found)
+	{
+		pg_atomic_init_u64(&Stats->prefetch, 0);
+		pg_atomic_init_u64(&Stats->hit, 0);
+		pg_atomic_init_u64(&Stats->skip_init, 0);
+		pg_atomic_init_u64(&Stats->skip_new, 0);
+		pg_atomic_init_u64(&Stats->skip_rep, 0);
+		pg_atomic_init_u32(&Stats->distance, 0);
+	}
+}
+
+/*
+ * Create a prefetcher for use by the startup process.
+ */
+XLogPrefetcher *
+XLogPrefetcherAllocate(void)
+{
+	XLogPrefetcher *prefetcher;
+	int			i;
+
+	prefetcher = palloc0(sizeof(XLogPrefetcher));
+	prefetcher->reader = XLogReaderAllocate(&XLogPrefetcherReadPage,
+											prefetcher);
+	if (prefetcher->reader == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OUT_OF_MEMORY),
+				 errmsg("out of memory"),
+			errdetail("Failed while allocating an XLog reading processor.")));
+	prefetcher->readFile = -1;
+	prefetcher->tli = 0;
+	prefetcher->stalled = false;
+	for (i = 0; i < XLOGPREFETCHER_RECENT_BLOCKS; i++)
+		prefetcher->recent[i].blkno = InvalidBlockNumber;
+
+	return prefetcher;
+}
+
+/*
+ * Release a prefetcher and the resources it holds.
+ */
+void
+XLogPrefetcherFree(XLogPrefetcher *prefetcher)
+{
+	XLogPrefetcherCloseSegment(prefetcher);
+	XLogReaderFree(prefetcher->reader);
+	pfree(prefetcher);
+
+	if (Stats)
+		pg_atomic_write_u32(&Stats->distance, 0);
+}
+
+/*
+ * Read ahead of replay, and issue prefetch hints for the blocks referenced
+ * by the records we find.
+ *
+ * replayEndPtr is the end of the record that replay is about to apply, and
+ * replayTLI the timeline it is on.  We decode records until we are
+ * recovery_prefetch_distance bytes ahead of it, or run out of WAL.
+ */
+void
+XLogPrefetcherReadAhead(XLogPrefetcher *prefetcher, XLogRecPtr replayEndPtr,
+						TimeLineID replayTLI)
+{
+	XLogReaderState *reader = prefetcher->reader;
+	uint64		distance = (uint64) recovery_prefetch_distance * 1024;
+
+	/* Disabled, or not supported on this platform */
+	if (distance == 0)
+		return;
+
+	/* Start over if the timeline changed, or if replay overtook us */
+	if (replayTLI != prefetcher->tli)
+	{
+		XLogPrefetcherCloseSegment(prefetcher);
+		prefetcher->tli = replayTLI;
+		XLogPrefetcherResync(prefetcher, replayEndPtr);
+	}
+	else if (reader->EndRecPtr < replayEndPtr)
+		XLogPrefetcherResync(prefetcher, replayEndPtr);
+
+	/*
+	 * After a failure, give the WAL source a chance to produce more data
+	 * before trying again.
+	 */
+	if (prefetcher->stalled)
+	{
+		if (replayEndPtr < prefetcher->stallReplayPtr)
+			return;
+		prefetcher->stalled = false;
+	}
+
+	while (reader->EndRecPtr - replayEndPtr < distance)
+	{
+		char	   *errormsg;
+
+		if (XLogReadRecord(reader, InvalidXLogRecPtr, &errormsg) == NULL)
+		{
+			/*
+			 * Wait until replay has consumed half of what we have read
+			 * ahead, or at least a page; the WAL is usually written in
+			 * larger chunks than one record at a time.
+			 */
+			prefetcher->stalled = true;
+			prefetcher->stallReplayPtr = replayEndPtr +
+				Max((reader->EndRecPtr - replayEndPtr) / 2, XLOG_BLCKSZ);
+			break;
+		}
+
+		XLogPrefetcherScanBlocks(prefetcher);
+	}
+
+	pg_atomic_write_u32(&Stats->distance,
+						(uint32) (reader->EndRecPtr - replayEndPtr));
+}
+
+/*
+ * Reposition the read-ahead reader at the end of the record that replay is
+ * about to apply.
+ */
+static void
+XLogPrefetcherResync(XLogPrefetcher *prefetcher, XLogRecPtr replayEndPtr)
+{
+	XLogReaderState *reader = prefetcher->reader;
+
+	/*
+	 * Continue reading at EndRecPtr, as in random access mode: the next
+	 * record's xl_prev can't be cross-checked, since we haven't read the
+	 * record it points to.
+	 */
+	reader->ReadRecPtr = InvalidXLogRecPtr;
+	reader->EndRecPtr = replayEndPtr;
+	prefetcher->stalled = false;
+}
+
+/*
+ * Issue prefetch hints for the blocks referenced by the record that the
+ * reader has just decoded.
+ */
+static void
+XLogPrefetcherScanBlocks(XLogPrefetcher *prefetcher)
+{
+	XLogReaderState *reader = prefetcher->reader;
+	int			block_id;
+
+	for (block_id = 0; block_id <= reader->max_block_id; block_id++)
+	{
+		DecodedBkpBlock *block = &reader->blocks[block_id];
+		SMgrRelation reln;
+
+		if (!block->in_use)
+			continue;
+
+		/* Replay won't read blocks that it restores or initializes */
+		if (block->has_image || (block->flags & BKPBLOCK_WILL_INIT) != 0)
+		{
+			pg_atomic_fetch_add_u64(&Stats->skip_init, 1);
+			continue;
+		}
+
+		if (XLogPrefetcherIsRecent(prefetcher, block->rnode, block->forknum,
+								   block->blkno))
+		{
+			pg_atomic_fetch_add_u64(&Stats->skip_rep, 1);
+			continue;
+		}
+
+		/*
+		 * The relation may not have been created yet, or the block may be
+		 * about to be added by an extension that is still ahead of replay.
+		 * There is nothing to read in either case.
+		 */
+		reln = smgropen(block->rnode, InvalidBackendId);
+		if (!smgrexists(reln, block->forknum) ||
+			block->blkno >= smgrnblocks(reln, block->forknum))
+		{
+			pg_atomic_fetch_add_u64(&Stats->skip_new, 1);
+			continue;
+		}
+
+#ifdef USE_PREFETCH
+		if (PrefetchSharedBuffer(reln, block->forknum, block->blkno))
+			pg_atomic_fetch_add_u64(&Stats->hit, 1);
+		else
+			pg_atomic_fetch_add_u64(&Stats->prefetch, 1);
+#endif
+	}
+}
+
+/*
+ * Check whether a block was prefetched recently, and remember it if not.
+ */
+static bool
+XLogPrefetcherIsRecent(XLogPrefetcher *prefetcher, RelFileNode rnode,
+					   ForkNumber forknum, BlockNumber blkno)
+{
+	XLogPrefetchRecentBlock *entry;
+	int			i;
+
+	for (i = 0; i < XLOGPREFETCHER_RECENT_BLOCKS; i++)
+	{
+		entry = &prefetcher->recent[i];
+		if (entry->blkno == blkno && entry->forknum == forknum &&
+			RelFileNodeEquals(entry->rnode, rnode))
+			return true;
+	}
+
+	entry = &prefetcher->recent[prefetcher->nextRecent];
+	entry->rnode = rnode;
+	entry->forknum = forknum;
+	entry->blkno = blkno;
+	prefetcher->nextRecent =
+		(prefetcher->nextRecent + 1) % XLOGPREFETCHER_RECENT_BLOCKS;
+
+	return false;
+}
+
+/*
+ * Page read callback for the read-ahead reader.
+ *
+ * Reads the page from the segment file in pg_xlog on the prefetcher's
+ * timeline.  Returns -1 if the page isn't available, without reporting an
+ * error; the reader's page validation catches pages that haven't been
+ * completely written yet.
+ */
+static int
+XLogPrefetcherReadPage(XLogReaderState *xlogreader, XLogRecPtr targetPagePtr,
+					   int reqLen, XLogRecPtr targetRecPtr, char *readBuf,
+					   TimeLineID *pageTLI)
+{
+	XLogPrefetcher *prefetcher = (XLogPrefetcher *) xlogreader->private_data;
+	XLogSegNo	targetSegNo;
+	uint32		targetPageOff;
+
+	XLByteToSeg(targetPagePtr, targetSegNo);
+	targetPageOff = targetPagePtr % XLogSegSize;
+
+	if (prefetcher->readFile >= 0 && targetSegNo != prefetcher->readSegNo)
+		XLogPrefetcherCloseSegment(prefetcher);
+
+	if (prefetcher->readFile < 0)
+	{
+		char		path[MAXPGPATH];
+
+		XLogFilePath(path, prefetcher->tli, targetSegNo);
+		prefetcher->readFile = BasicOpenFile(path, O_RDONLY | PG_BINARY, 0);
+		if (prefetcher->readFile < 0)
+			return -1;
+		prefetcher->readSegNo = targetSegNo;
+	}
+
+	if (lseek(prefetcher->readFile, (off_t) targetPageOff, SEEK_SET) < 0)
+		return -1;
+	if (read(prefetcher->readFile, readBuf, XLOG_BLCKSZ) != XLOG_BLCKSZ)
+		return -1;
+
+	*pageTLI = prefetcher->tli;
+	return XLOG_BLCKSZ;
+}
+
+static void
+XLogPrefetcherCloseSegment(XLogPrefetcher *prefetcher)
+{
+	if (prefetcher->readFile >= 0)
+	{
+		close(prefetcher->readFile);
+		prefetcher->readFile = -1;
+	}
+}
+
+/*
+ * SQL-callable function returning the prefetch statistics.
+ */
+Datum
+pg_stat_get_recovery_prefetch(PG_FUNCTION_ARGS)
+{
+	TupleDesc	tupdesc;
+	Datum		values[6];
+	bool		nulls[6];
+
+	MemSet(nulls, 0, sizeof(nulls));
+
+	tupdesc = CreateTemplateTupleDesc(6, false);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 1, "prefetch",
+					   INT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 2, "hit",
+					   INT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 3, "skip_init",
+					   INT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 4, "skip_new",
+					   INT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 5, "skip_rep",
+					   INT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 6, "distance",
+					   INT4OID, -1, 0);
+	BlessTupleDesc(tupdesc);
+
+	values[0] = Int64GetDatum((int64) pg_atomic_read_u64(&Stats->prefetch));
+	values[1] = Int64GetDatum((int64) pg_atomic_read_u64(&Stats->hit));
+	values[2] = Int64GetDatum((int64) pg_atomic_read_u64(&Stats->skip_init));
+	values[3] = Int64GetDatum((int64) pg_atomic_read_u64(&Stats->skip_new));
+	values[4] = Int64GetDatum((int64) pg_atomic_read_u64(&Stats->skip_rep));
+	values[5] = Int32GetDatum((int32) pg_atomic_read_u32(&Stats->distance));
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
@@ -0,0 +1,667 @@
+/*-------------------------------------------------------------------------
+ *
+ * xlogredoworker.c
+ *		Parallel application of WAL records during recovery.
+ *
+ * Normally the startup process replays every WAL record itself, one after
+ * another.  When recovery_workers is set, records that modify only a single
+ * data block are instead handed to one of several redo workers, which are
+ * dynamic background workers started by the startup process.  A record is
+ * always sent to the worker chosen by hashing the relation it modifies, so
+ * all changes to one relation are still applied in WAL order; changes to
+ * different relations may be applied in any order relative to each other.
+ * Hashing by block would not do: redo extends relations without taking the
+ * relation extension lock, since normally only the startup process does
+ * that, so two workers extending the same fork at once could both pick the
+ * same new block.  That goes for all forks of the relation, as heap redo
+ * also extends the free space map.
+ *
+ * Every other record acts as a barrier: before replaying it, the startup
+ * process waits for all workers to finish the records sent to them so far.
+ * In particular, that is true of commit and abort records, so when a
+ * transaction becomes visible to hot standby queries, all of its changes
+ * have been applied.  For the same reason, lastReplayedEndRecPtr only moves
+ * past records applied by workers once the next barrier has been reached.
+ *
+ * The records that can be dispatched are those whose redo routine does
+ * nothing but read and modify the referenced block: heap records other
+ * than in-place updates, B-tree leaf insertions, and full-page images.
+ * Everything that has to resolve recovery conflicts, take a cleanup lock,
+ * or maintain state of the startup process is replayed serially.
+ *
+ * Workers are only used once a consistent state has been reached, since
+ * until then references to missing pages are tracked in memory of the
+ * startup process.  Workers run with reachedConsistency set, so that a
+ * reference to a missing page is a PANIC in a worker just as it is in the
+ * startup process after that point.  As crash recovery never reaches
+ * consistency before the end of WAL, crash recovery is always serial.
+ *
+ * Records are passed to the workers through a shm_mq per worker, in their
+ * raw form; each worker decodes them again with its own XLogReaderState.
+ * Workers report progress by counting the messages they have processed,
+ * and set the startup process's latch whenever their queue runs empty.
+ *
+ * Workers keep smgr relations open across records.  So that a worker
+ * doesn't write to a file that has since been unlinked, whenever a record
+ * that drops or truncates relations is replayed, all workers are told to
+ * close their files first.
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * src/backend/access/transam/xlogredoworker.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/hash.h"
+#include "access/heapam_xlog.h"
+#include "access/nbtree.h"
+#include "access/rmgr.h"
+#include "access/xact.h"
+#include "access/xlog.h"
+#include "access/xlog_internal.h"
+#include "access/xlogredoworker.h"
+#include "catalog/pg_control.h"
+#include "lib/stringinfo.h"
+#include "miscadmin.h"
+#include "port/atomics.h"
+#include "postmaster/bgworker.h"
+#include "postmaster/startup.h"
+#include "storage/dsm.h"
+#include "storage/latch.h"
+#include "storage/proc.h"
+#include "storage/shm_mq.h"
+#include "storage/shm_toc.h"
+#include "storage/smgr.h"
+#include "storage/spin.h"
+#include "utils/memutils.h"
+#include "utils/resowner.h"
+
+/* GUC variable */
+int			recovery_workers = 0;
+
+/* Magic number for redo worker shared memory */
+#define REDO_WORKER_MAGIC			0x52444f57
+
+/* Size of each worker's message queue */
+#define REDO_WORKER_QUEUE_SIZE		131072
+
+/* Keys for redo worker shared memory */
+#define REDO_KEY_SHARED				0
+#define REDO_KEY_QUEUES				1
+
+/* Message types */
+#define REDO_MSG_RECORD				'R'
+#define REDO_MSG_CLOSE_SMGR			'C'
+
+/*
+ * Header of each message sent to a worker.  For REDO_MSG_RECORD, the raw
+ * record follows, starting at a MAXALIGN'd offset so that the worker can
+ * decode it in place.
+ */
+typedef struct RedoWorkerMessage
+{
+	char		type;
+	XLogRecPtr	ReadRecPtr;
+	XLogRecPtr	EndRecPtr;
+} RedoWorkerMessage;
+
+#define SizeOfRedoWorkerMessage		MAXALIGN(sizeof(RedoWorkerMessage))
+
+/* State shared between the startup process and the workers */
+typedef struct RedoWorkerShared
+{
+	PGPROC	   *startup;		/* whose latch to set when idle */
+	slock_t		mutex;			/* protects nattached */
+	int			nworkers;
+	int			nattached;		/* used to assign worker numbers */
+	pg_atomic_uint64 napplied[FLEXIBLE_ARRAY_MEMBER];	/* per worker */
+} RedoWorkerShared;
+
+/* Startup process's bookkeeping for each worker */
+typedef struct RedoWorkerState
+{
+	BackgroundWorkerHandle *handle;
+	shm_mq_handle *mqh;
+	uint64		nsent;			/* messages sent so far */
+} RedoWorkerState;
+
+static dsm_segment *redo_seg = NULL;
+static RedoWorkerShared *redo_shared = NULL;
+static RedoWorkerState *redo_workers = NULL;
+static bool redo_workers_failed = false;
+
+/* Have messages been sent since the workers were last known to be idle? */
+static bool redo_workers_busy = false;
+
+static bool RedoWorkersStart(void);
+static void RedoWorkersWaitIdle(void);
+static int	RedoWorkerForRecord(XLogReaderState *record);
+static bool RedoRecordDropsRelations(XLogReaderState *record);
+static void RedoWorkerSend(int worker, char type, XLogReaderState *record);
+static void redo_worker_error_callback(void *arg);
+
+/*
+ * Hand a WAL record to a redo worker, if it can be replayed out of order.
+ *
+ * Returns true if the record was sent to a worker; the caller must not
+ * replay it.  Otherwise, waits until the workers have applied all records
+ * sent to them so far, and returns false; the caller then replays the
+ * record itself.
+ */
+bool
+RedoWorkerDispatch(XLogReaderState *record)
+{
+	int			worker;
+	int			i;
+
+	if (recovery_workers == 0 || redo_workers_failed || !reachedConsistency)
+		return false;
+
+	worker = RedoWorkerForRecord(record);
+	if (worker < 0)
+	{
+		if (redo_workers != NULL)
+		{
+			RedoWorkersWaitIdle();
+
+			if (RedoRecordDropsRelations(record))
+			{
+				for (i = 0; i < recovery_workers; i++)
+					RedoWorkerSend(i, REDO_MSG_CLOSE_SMGR, NULL);
+			}
+		}
+		return false;
+	}
+
+	if (redo_workers == NULL && !RedoWorkersStart())
+	{
+		redo_workers_failed = true;
+		return false;
+	}
+
+	RedoWorkerSend(worker, REDO_MSG_RECORD, record);
+	return true;
+}
+
+/*
+ * Wait for all workers to apply what has been sent to them, and stop them.
+ *
+ * Called by the startup process at the end of redo.
+ */
+void
+RedoWorkersShutdown(void)
+{
+	int			i;
+
+	if (redo_workers == NULL)
+		return;
+
+	RedoWorkersWaitIdle();
+
+	/* Detaching from the queues tells the workers to exit */
+	dsm_detach(redo_seg);
+	redo_seg = NULL;
+	redo_shared = NULL;
+
+	for (i = 0; i < recovery_workers; i++)
+	{
+		(void) WaitForBackgroundWorkerShutdown(redo_workers[i].handle);
+		pfree(redo_workers[i].handle);
+	}
+
+	pfree(redo_workers);
+	redo_workers = NULL;
+}
+
+/*
+ * Set up shared memory and launch the workers.
+ *
+ * Returns false if that's not possible, for instance because there are no
+ * free background worker slots; recovery then carries on serially.
+ */
+static bool
+RedoWorkersStart(void)
+{
+	shm_toc_estimator e;
+	shm_toc    *toc;
+	Size		shared_size;
+	Size		queues_size;
+	Size		segsize;
+	char	   *queues;
+	ResourceOwner saveResourceOwner;
+	MemoryContext oldcontext;
+	BackgroundWorker worker;
+	int			i;
+
+	shared_size = add_size(offsetof(RedoWorkerShared, napplied),
+						   mul_size(sizeof(pg_atomic_uint64), recovery_workers));
+	queues_size = mul_size(REDO_WORKER_QUEUE_SIZE, recovery_workers);
+
+	shm_toc_initialize_estimator(&e);
+	shm_toc_estimate_chunk(&e, shared_size);
+	shm_toc_estimate_chunk(&e, queues_size);
+	shm_toc_estimate_keys(&e, 2);
+	segsize = shm_toc_estimate(&e);
+
+	/*
+	 * The startup process has no resource owner, so make a temporary one for
+	 * dsm_create, and pin the mapping so that it survives until we detach.
+	 */
+	saveResourceOwner = CurrentResourceOwner;
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, "redo workers");
+	redo_seg = dsm_create(segsize, DSM_CREATE_NULL_IF_MAXSEGMENTS);
+	if (redo_seg != NULL)
+		dsm_pin_mapping(redo_seg);
+	ResourceOwnerDelete(CurrentResourceOwner);
+	CurrentResourceOwner = saveResourceOwner;
+
+	if (redo_seg == NULL)
+	{
+		ereport(LOG,
+				(errmsg("could not create shared memory for redo workers, replaying WAL serially")));
+		return false;
+	}
+
+	toc = shm_toc_create(REDO_WORKER_MAGIC, dsm_segment_address(redo_seg),
+						 segsize);
+
+	redo_shared = shm_toc_allocate(toc, shared_size);
+	redo_shared->startup = MyProc;
+	SpinLockInit(&redo_shared->mutex);
+	redo_shared->nworkers = recovery_workers;
+	redo_shared->nattached = 0;
+	for (i = 0; i < recovery_workers; i++)
+		pg_atomic_init_u64(&redo_shared->napplied[i], 0);
+	shm_toc_insert(toc, REDO_KEY_SHARED, redo_shared);
+
+	queues = shm_toc_allocate(toc, queues_size);
+	shm_toc_insert(toc, REDO_KEY_QUEUES, queues);
+
+	memset(&worker, 0, sizeof(worker));
+	snprintf(worker.bgw_name, BGW_MAXLEN, "redo worker for PID %d",
+			 MyProcPid);
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS;
+	worker.bgw_start_time = BgWorkerStart_PostmasterStart;
+	worker.bgw_restart_time = BGW_NEVER_RESTART;
+	worker.bgw_main = RedoWorkerMain;
+	worker.bgw_main_arg = UInt32GetDatum(dsm_segment_handle(redo_seg));
+	worker.bgw_notify_pid = MyProcPid;
+
+	oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+
+	redo_workers = palloc0(sizeof(RedoWorkerState) * recovery_workers);
+	for (i = 0; i < recovery_workers; i++)
+	{
+		shm_mq	   *mq;
+
+		mq = shm_mq_create(queues + i * REDO_WORKER_QUEUE_SIZE,
+						   REDO_WORKER_QUEUE_SIZE);
+		shm_mq_set_sender(mq, MyProc);
+		redo_workers[i].mqh = shm_mq_attach(mq, redo_seg, NULL);
+
+		if (!RegisterDynamicBackgroundWorker(&worker,
+											 &redo_workers[i].handle))
+		{
+			int			j;
+
+			ereport(LOG,
+					(errmsg("could not start %d redo workers, replaying WAL serially",
+							recovery_workers),
+					 errhint("You might need to increase max_worker_processes.")));
+
+			/* Workers already registered exit when they see us detach */
+			dsm_detach(redo_seg);
+			redo_seg = NULL;
+			redo_shared = NULL;
+			for (j = 0; j < i; j++)
+				pfree(redo_workers[j].handle);
+			pfree(redo_workers);
+			redo_workers = NULL;
+
+			MemoryContextSwitchTo(oldcontext);
+			return false;
+		}
+		shm_mq_set_handle(redo_workers[i].mqh, redo_workers[i].handle);
+	}
+
+	MemoryContextSwitchTo(oldcontext);
+
+	ereport(DEBUG1,
+			(errmsg("started %d redo workers", recovery_workers)));
+
+	return true;
+}
+
+/*
+ * Wait until every worker has processed all messages sent to it.
+ */
+static void
+RedoWorkersWaitIdle(void)
+{
+	if (!redo_workers_busy)
+		return;
+
+	for (;;)
+	{
+		int			i;
+		bool		idle = true;
+
+		ResetLatch(MyLatch);
+
+		for (i = 0; i < recovery_workers; i++)
+		{
+			pid_t		pid;
+
+			if (pg_atomic_read_u64(&redo_shared->napplied[i]) ==
+				redo_workers[i].nsent)
+				continue;
+
+			if (GetBackgroundWorkerPid(redo_workers[i].handle, &pid) ==
+				BGWH_STOPPED)
+				ereport(FATAL,
+						(errmsg("redo worker %d terminated unexpectedly", i)));
+			idle = false;
+			break;
+		}
+
+		if (idle)
+			break;
+
+		(void) WaitLatch(MyLatch,
+						 WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+						 1000L);
+
+		/* Handle interrupt signals of startup process */
+		HandleStartupProcInterrupts();
+	}
+
+	redo_workers_busy = false;
+}
+
+/*
+ * Decide which worker, if any, may replay a record.  All records for one
+ * relation go to the same worker, whichever fork and block they modify.
+ *
+ * Returns -1 if the record has to be replayed by the startup process.
+ */
+static int
+RedoWorkerForRecord(XLogReaderState *record)
+{
+	uint8		info = XLogRecGetInfo(record) & ~XLR_INFO_MASK;
+	DecodedBkpBlock *block;
+
+	/* Only records touching a single block can be applied out of order */
+	if (record->max_block_id != 0 || !record->blocks[0].in_use)
+		return -1;
+
+	switch (XLogRecGetRmid(record))
+	{
+		case RM_XLOG_ID:
+			if (info != XLOG_FPI && info != XLOG_FPI_FOR_HINT)
+				return -1;
+			break;
+
+		case RM_HEAP_ID:
+			/* in-place updates are followed by cache invalidations */
+			if ((info & XLOG_HEAP_OPMASK) == XLOG_HEAP_INPLACE)
+				return -1;
+			break;
+
+		case RM_BTREE_ID:
+			if (info != XLOG_BTREE_INSERT_LEAF)
+				return -1;
+			break;
+
+		default:
+			return -1;
+	}
+
+	block = &record->blocks[0];
+
+	return DatumGetUInt32(hash_any((unsigned char *) &block->rnode,
+								   sizeof(RelFileNode))) %
+		recovery_workers;
+}
+
+/*
+ * Does replaying this record drop or truncate relation files?
+ */
+static bool
+RedoRecordDropsRelations(XLogReaderState *record)
+{
+	uint8		info = XLogRecGetInfo(record) & ~XLR_INFO_MASK;
+
+	switch (XLogRecGetRmid(record))
+	{
+		case RM_SMGR_ID:
+		case RM_DBASE_ID:
+		case RM_TBLSPC_ID:
+			return true;
+
+		case RM_XACT_ID:
+			switch (info & XLOG_XACT_OPMASK)
+			{
+				case XLOG_XACT_COMMIT:
+				case XLOG_XACT_COMMIT_PREPARED:
+					{
+						xl_xact_parsed_commit parsed;
+
+						ParseCommitRecord(XLogRecGetInfo(record),
+								   (xl_xact_commit *) XLogRecGetData(record),
+										  &parsed);
+						return parsed.nrels > 0;
+					}
+				case XLOG_XACT_ABORT:
+				case XLOG_XACT_ABORT_PREPARED:
+					{
+						xl_xact_parsed_abort parsed;
+
+						ParseAbortRecord(XLogRecGetInfo(record),
+									(xl_xact_abort *) XLogRecGetData(record),
+										 &parsed);
+						return parsed.nrels > 0;
+					}
+				default:
+					return false;
+			}
+
+		default:
+			return false;
+	}
+}
+
+/*
+ * Send a message to a worker, blocking if its queue is full.
+ */
+static void
+RedoWorkerSend(int worker, char type, XLogReaderState *record)
+{
+	union
+	{
+		RedoWorkerMessage msg;
+		char		pad[SizeOfRedoWorkerMessage];
+	}			header;
+	shm_mq_iovec iov[2];
+	int			iovcnt = 1;
+	shm_mq_result res;
+
+	memset(&header, 0, sizeof(header));
+	header.msg.type = type;
+	iov[0].data = header.pad;
+	iov[0].len = SizeOfRedoWorkerMessage;
+
+	if (record != NULL)
+	{
+		header.msg.ReadRecPtr = record->ReadRecPtr;
+		header.msg.EndRecPtr = record->EndRecPtr;
+		iov[1].data = (char *) record->decoded_record;
+		iov[1].len = record->decoded_record->xl_tot_len;
+		iovcnt = 2;
+	}
+
+	res = shm_mq_sendv(redo_workers[worker].mqh, iov, iovcnt, false);
+	if (res != SHM_MQ_SUCCESS)
+		ereport(FATAL,
+				(errmsg("redo worker %d terminated unexpectedly", worker)));
+
+	redo_workers[worker].nsent++;
+	redo_workers_busy = true;
+}
+
+/*
+ * Main entry point for redo workers.
+ */
+void
+RedoWorkerMain(Datum main_arg)
+{
+	dsm_segment *seg;
+	shm_toc    *toc;
+	RedoWorkerShared *shared;
+	shm_mq	   *mq;
+	shm_mq_handle *mqh;
+	XLogReaderState *reader;
+	MemoryContext redo_context;
+	int			myindex;
+	uint64		napplied = 0;
+
+	/* Establish signal handlers; the defaults are fine for us. */
+	BackgroundWorkerUnblockSignals();
+
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, "redo worker");
+
+	seg = dsm_attach(DatumGetUInt32(main_arg));
+	if (seg == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("could not map dynamic shared memory segment")));
+	toc = shm_toc_attach(REDO_WORKER_MAGIC, dsm_segment_address(seg));
+	if (toc == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+			   errmsg("invalid magic number in dynamic shared memory segment")));
+
+	shared = shm_toc_lookup(toc, REDO_KEY_SHARED);
+	SpinLockAcquire(&shared->mutex);
+	myindex = shared->nattached++;
+	SpinLockRelease(&shared->mutex);
+	Assert(myindex < shared->nworkers);
+
+	mq = (shm_mq *) ((char *) shm_toc_lookup(toc, REDO_KEY_QUEUES) +
+					 myindex * REDO_WORKER_QUEUE_SIZE);
+	shm_mq_set_receiver(mq, MyProc);
+	mqh = shm_mq_attach(mq, seg, NULL);
+
+	/*
+	 * Redo routines expect to run with these set, as in the startup process.
+	 * We're only started once a consistent state has been reached, and
+	 * invalid page references must be reported as they are then.
+	 */
+	InRecovery = true;
+	reachedConsistency = true;
+
+	reader = XLogReaderAllocate(NULL, NULL);
+	if (reader == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OUT_OF_MEMORY),
+				 errmsg("out of memory"),
+			errdetail("Failed while allocating an XLog reading processor.")));
+
+	redo_context = AllocSetContextCreate(TopMemoryContext,
+										 "redo worker",
+										 ALLOCSET_DEFAULT_MINSIZE,
+										 ALLOCSET_DEFAULT_INITSIZE,
+										 ALLOCSET_DEFAULT_MAXSIZE);
+
+	for (;;)
+	{
+		shm_mq_result res;
+		Size		nbytes;
+		void	   *data;
+		RedoWorkerMessage *msg;
+
+		res = shm_mq_receive(mqh, &nbytes, &data, true);
+		if (res == SHM_MQ_WOULD_BLOCK)
+		{
+			/* Out of work; let the startup process know, then wait */
+			SetLatch(&shared->startup->procLatch);
+			res = shm_mq_receive(mqh, &nbytes, &data, false);
+		}
+
+		/* The startup process detaches when redo is done */
+		if (res != SHM_MQ_SUCCESS)
+			break;
+
+		if (nbytes < SizeOfRedoWorkerMessage)
+			elog(ERROR, "invalid message from startup process");
+		msg = (RedoWorkerMessage *) data;
+
+		if (msg->type == REDO_MSG_RECORD)
+		{
+			XLogRecord *record;
+			char	   *errormsg;
+			ErrorContextCallback errcallback;
+			MemoryContext oldcontext;
+
+			record = (XLogRecord *) ((char *) data + SizeOfRedoWorkerMessage);
+			reader->ReadRecPtr = msg->ReadRecPtr;
+			reader->EndRecPtr = msg->EndRecPtr;
+			if (!DecodeXLogRecord(reader, record, &errormsg))
+				elog(ERROR, "could not decode WAL record at %X/%X: %s",
+					 (uint32) (msg->ReadRecPtr >> 32),
+					 (uint32) msg->ReadRecPtr, errormsg);
+
+			/* Setup error traceback support for ereport() */
+			errcallback.callback = redo_worker_error_callback;
+			errcallback.arg = (void *) reader;
+			errcallback.previous = error_context_stack;
+			error_context_stack = &errcallback;
+
+			oldcontext = MemoryContextSwitchTo(redo_context);
+			RmgrTable[record->xl_rmid].rm_redo(reader);
+			MemoryContextSwitchTo(oldcontext);
+			MemoryContextReset(redo_context);
+
+			error_context_stack = errcallback.previous;
+		}
+		else if (msg->type == REDO_MSG_CLOSE_SMGR)
+			smgrcloseall();
+		else
+			elog(ERROR, "unrecognized redo worker message type: %d",
+				 msg->type);
+
+		pg_atomic_write_u64(&shared->napplied[myindex], ++napplied);
+	}
+}
+
+/*
+ * Error context callback for errors occurring during rm_redo() in a worker.
+ */
+static void
+redo_worker_error_callback(void *arg)
+{
+	XLogReaderState *record = (XLogReaderState *) arg;
+	RmgrId		rmid = XLogRecGetRmid(record);
+	uint8		info = XLogRecGetInfo(record);
+	const char *id;
+	StringInfoData buf;
+
+	initStringInfo(&buf);
+	appendStringInfoString(&buf, RmgrTable[rmid].rm_name);
+	appendStringInfoChar(&buf, '/');
+
+	id = RmgrTable[rmid].rm_identify(info);
+	if (id == NULL)
+		appendStringInfo(&buf, "UNKNOWN (%X): ", info & ~XLR_INFO_MASK);
+	else
+		appendStringInfo(&buf, "%s: ", id);
+
+	RmgrTable[rmid].rm_desc(&buf, record);
+
+	errcontext("xlog redo %s", buf.data);
+
+	pfree(buf.data);
+}
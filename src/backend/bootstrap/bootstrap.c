@@ -28,6 +28,7 @@
 #include "pg_getopt.h"
 #include "postmaster/bgwriter.h"
 #include "postmaster/startup.h"
+#include "postmaster/walsummarizer.h"
 #include "postmaster/walwriter.h"
 #include "replication/walreceiver.h"
 #include "storage/bufmgr.h"
@@ -318,6 +319,9 @@ AuxiliaryProcessMain(int argc, char *argv[])
 			case WalReceiverProcess:
 				statmsg = "wal receiver process";
 				break;
+			case WalSummarizerProcess:
+				statmsg = "wal summarizer process";
+				break;
 			default:
 				statmsg = "??? process";
 				break;
@@ -347,9 +351,15 @@ AuxiliaryProcessMain(int argc, char *argv[])
 	SetProcessingMode(BootstrapProcessing);
 	IgnoreSystemIndexes = true;
 
-	/* Initialize MaxBackends (if under postmaster, was done already) */
+	/*
+	 * Initialize MaxBackends and the fast-path lock arrays' size (if under
+	 * postmaster, was done already)
+	 */
 	if (!IsUnderPostmaster)
+	{
 		InitializeMaxBackends();
+		InitializeFastPathLocks();
+	}
 
 	BaseInit();
 
@@ -439,6 +449,12 @@ AuxiliaryProcessMain(int argc, char *argv[])
 			WalReceiverMain();
 			proc_exit(1);		/* should never return */
 
+		case WalSummarizerProcess:
+			/* don't set signals, WAL summarizer has its own agenda */
+			InitXLOGAccess();
+			WalSummarizerMain();
+			proc_exit(1);		/* should never return */
+
 		default:
 			elog(PANIC, "unrecognized process type: %d", (int) MyAuxProcType);
 			proc_exit(1);
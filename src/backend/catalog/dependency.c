@@ -1884,6 +1884,7 @@ find_expr_references_walker(Node *node,
 
 		/* we need to look at the groupClauses for operator references */
 		find_expr_references_walker((Node *) setop->groupClauses, context);
+		find_expr_references_walker((Node *) setop->cycleClauses, context);
 		/* fall through to examine child nodes */
 	}
 	else if (IsA(node, RangeTblFunction))
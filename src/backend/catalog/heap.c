@@ -53,6 +53,7 @@
 #include "catalog/pg_type_fn.h"
 #include "catalog/storage.h"
 #include "catalog/storage_xlog.h"
+#include "commands/sequence.h"
 #include "commands/tablecmds.h"
 #include "commands/typecmds.h"
 #include "miscadmin.h"
@@ -1807,6 +1808,13 @@ heap_drop_with_catalog(Oid relid)
 		RelationDropStorage(rel);
 	}
 
+	/*
+	 * Forget any values of a sequence set aside in shared memory, so that a
+	 * later sequence with the same OIDs can't pick them up.
+	 */
+	if (rel->rd_rel->relkind == RELKIND_SEQUENCE)
+		ForgetSharedSequenceCaches(MyDatabaseId, relid);
+
 	/*
 	 * Close relcache entry, but *keep* AccessExclusiveLock on the relation
 	 * until transaction commit.  This ensures no one else will try to do
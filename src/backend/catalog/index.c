@@ -53,6 +53,7 @@
 #include "optimizer/clauses.h"
 #include "parser/parser.h"
 #include "storage/bufmgr.h"
+#include "storage/dsm_impl.h"
 #include "storage/lmgr.h"
 #include "storage/predicate.h"
 #include "storage/procarray.h"
@@ -106,6 +107,15 @@ static void UpdateIndexRelation(Oid indexoid, Oid heapoid,
 static void index_update_stats(Relation rel,
 				   bool hasindex, bool isprimary,
 				   double reltuples);
+static double IndexBuildHeapScanInternal(Relation heapRelation,
+						   Relation indexRelation,
+						   IndexInfo *indexInfo,
+						   bool allow_sync,
+						   BlockNumber start_blockno,
+						   BlockNumber numblocks,
+						   ParallelHeapScanDesc parallel_scan,
+						   IndexBuildCallback callback,
+						   void *callback_state);
 static void IndexCheckExclusion(Relation heapRelation,
 					Relation indexRelation,
 					IndexInfo *indexInfo);
@@ -425,6 +435,10 @@ ConstructTupleDescriptor(Relation heapRelation,
 		namestrcpy(&to->attname, (const char *) lfirst(colnames_item));
 		colnames_item = lnext(colnames_item);
 
+		/* Non-key INCLUDE columns have no opclass, and keep the heap type */
+		if (i >= indexInfo->ii_NumIndexKeyAttrs)
+			continue;
+
 		/*
 		 * Check the opclass and index AM to see if either provides a keytype
 		 * (overriding the attribute type).  Opclass takes precedence.
@@ -606,6 +620,7 @@ UpdateIndexRelation(Oid indexoid,
 	values[Anum_pg_index_indexrelid - 1] = ObjectIdGetDatum(indexoid);
 	values[Anum_pg_index_indrelid - 1] = ObjectIdGetDatum(heapoid);
 	values[Anum_pg_index_indnatts - 1] = Int16GetDatum(indexInfo->ii_NumIndexAttrs);
+	values[Anum_pg_index_indnkeyatts - 1] = Int16GetDatum(indexInfo->ii_NumIndexKeyAttrs);
 	values[Anum_pg_index_indisunique - 1] = BoolGetDatum(indexInfo->ii_Unique);
 	values[Anum_pg_index_indisprimary - 1] = BoolGetDatum(primary);
 	values[Anum_pg_index_indisexclusion - 1] = BoolGetDatum(isexclusion);
@@ -1011,7 +1026,7 @@ index_create(Relation heapRelation,
 		}
 
 		/* Store dependency on operator classes */
-		for (i = 0; i < indexInfo->ii_NumIndexAttrs; i++)
+		for (i = 0; i < indexInfo->ii_NumIndexKeyAttrs; i++)
 		{
 			referenced.classId = OperatorClassRelationId;
 			referenced.objectId = classObjectId[i];
@@ -1637,6 +1652,10 @@ BuildIndexInfo(Relation index)
 		elog(ERROR, "invalid indnatts %d for index %u",
 			 numKeys, RelationGetRelid(index));
 	ii->ii_NumIndexAttrs = numKeys;
+	ii->ii_NumIndexKeyAttrs = indexStruct->indnkeyatts;
+	if (ii->ii_NumIndexKeyAttrs < 1 || ii->ii_NumIndexKeyAttrs > numKeys)
+		elog(ERROR, "invalid indnkeyatts %d for index %u",
+			 ii->ii_NumIndexKeyAttrs, RelationGetRelid(index));
 	for (i = 0; i < numKeys; i++)
 		ii->ii_KeyAttrNumbers[i] = indexStruct->indkey.values[i];
 
@@ -1693,7 +1712,7 @@ BuildIndexInfo(Relation index)
 void
 BuildSpeculativeIndexInfo(Relation index, IndexInfo *ii)
 {
-	int			ncols = index->rd_rel->relnatts;
+	int			ncols = IndexRelationGetNumberOfKeyAttributes(index);
 	int			i;
 
 	/*
@@ -1921,7 +1940,7 @@ index_update_stats(Relation rel,
 		BlockNumber relallvisible;
 
 		if (rd_rel->relkind != RELKIND_INDEX)
-			relallvisible = visibilitymap_count(rel);
+			relallvisible = visibilitymap_count(rel, NULL);
 		else	/* don't bother for indexes */
 			relallvisible = 0;
 
@@ -2179,6 +2198,103 @@ IndexBuildHeapRangeScan(Relation heapRelation,
 						BlockNumber numblocks,
 						IndexBuildCallback callback,
 						void *callback_state)
+{
+	return IndexBuildHeapScanInternal(heapRelation, indexRelation,
+									  indexInfo, allow_sync,
+									  start_blockno, numblocks, NULL,
+									  callback, callback_state);
+}
+
+/*
+ * As IndexBuildHeapScan, except that the heap is scanned as one participant
+ * in a parallel heap scan: only the blocks this backend claims from
+ * parallel_scan are visited, and the other participants see the rest.  The
+ * tuple count returned covers only this backend's share.  This is not
+ * supported for concurrent builds or in bootstrap mode.
+ */
+double
+IndexBuildHeapParallelScan(Relation heapRelation,
+						   Relation indexRelation,
+						   IndexInfo *indexInfo,
+						   ParallelHeapScanDesc parallel_scan,
+						   IndexBuildCallback callback,
+						   void *callback_state)
+{
+	return IndexBuildHeapScanInternal(heapRelation, indexRelation,
+									  indexInfo, true,
+									  0, InvalidBlockNumber, parallel_scan,
+									  callback, callback_state);
+}
+
+/*
+ * IndexBuildParallelWorkers - how many workers to use for building an index
+ *
+ * Returns the number of background workers an access method should launch to
+ * help scan the heap for a build of the given index, or 0 if the build can't
+ * or shouldn't be done in parallel.  The count grows with the logarithm of
+ * the heap's size, as for a parallel sequential scan, up to
+ * max_parallel_maintenance_workers.  Callers are expected to reduce it
+ * further if dividing maintenance_work_mem among that many participants
+ * would leave each too little.
+ */
+int
+IndexBuildParallelWorkers(Relation heapRelation, IndexInfo *indexInfo)
+{
+	BlockNumber nblocks;
+	BlockNumber threshold = 1000;
+	int			nworkers = 1;
+
+	if (max_parallel_maintenance_workers <= 0)
+		return 0;
+
+	/*
+	 * Workers can't be started in a standalone backend or without dynamic
+	 * shared memory, and can't start workers of their own.  Workers also
+	 * need an active snapshot to be copied to them.
+	 */
+	if (!IsUnderPostmaster || dynamic_shared_memory_type == DSM_IMPL_NONE ||
+		IsInParallelMode() || IsBootstrapProcessingMode() ||
+		!ActiveSnapshotSet())
+		return 0;
+
+	/*
+	 * A concurrent build scans with an MVCC snapshot of its own, and
+	 * temporary tables live in the leader's local buffers.  Workers also
+	 * rely on the leader's locks, which is safe for user tables only.
+	 */
+	if (indexInfo->ii_Concurrent || IsSystemRelation(heapRelation) ||
+		RelationUsesLocalBuffers(heapRelation))
+		return 0;
+
+	/* Index expressions and predicates must be safe to run in a worker */
+	if (has_parallel_hazard((Node *) indexInfo->ii_Expressions, false) ||
+		has_parallel_hazard((Node *) indexInfo->ii_Predicate, false))
+		return 0;
+
+	nblocks = RelationGetNumberOfBlocks(heapRelation);
+	if (nblocks < threshold)
+		return 0;
+	while (nblocks >= threshold * 3 && nworkers < max_parallel_maintenance_workers)
+	{
+		nworkers++;
+		threshold *= 3;
+		if (threshold > INT_MAX / 3)
+			break;
+	}
+
+	return nworkers;
+}
+
+static double
+IndexBuildHeapScanInternal(Relation heapRelation,
+						   Relation indexRelation,
+						   IndexInfo *indexInfo,
+						   bool allow_sync,
+						   BlockNumber start_blockno,
+						   BlockNumber numblocks,
+						   ParallelHeapScanDesc parallel_scan,
+						   IndexBuildCallback callback,
+						   void *callback_state)
 {
 	bool		is_system_catalog;
 	bool		checking_uniqueness;
@@ -2243,15 +2359,23 @@ IndexBuildHeapRangeScan(Relation heapRelation,
 		OldestXmin = GetOldestXmin(heapRelation, true);
 	}
 
-	scan = heap_beginscan_strat(heapRelation,	/* relation */
-								snapshot,		/* snapshot */
-								0,		/* number of keys */
-								NULL,	/* scan key */
-								true,	/* buffer access strategy OK */
-								allow_sync);	/* syncscan OK? */
-
-	/* set our scan endpoints */
-	heap_setscanlimits(scan, start_blockno, numblocks);
+	if (parallel_scan != NULL)
+	{
+		Assert(snapshot == SnapshotAny);
+		scan = heap_beginscan_parallel(heapRelation, snapshot, parallel_scan);
+	}
+	else
+	{
+		scan = heap_beginscan_strat(heapRelation,	/* relation */
+									snapshot,	/* snapshot */
+									0,	/* number of keys */
+									NULL,		/* scan key */
+									true,		/* buffer access strategy OK */
+									allow_sync);		/* syncscan OK? */
+
+		/* set our scan endpoints */
+		heap_setscanlimits(scan, start_blockno, numblocks);
+	}
 
 	reltuples = 0;
 
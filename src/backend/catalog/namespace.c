@@ -2982,6 +2982,18 @@ isTempNamespace(Oid namespaceId)
 	return false;
 }
 
+/*
+ * isTempNamespaceInUse - has this session set up its temporary namespace?
+ *
+ * This is true from the first creation of a temporary object until backend
+ * exit; we don't try to tell whether any temporary objects remain.
+ */
+bool
+isTempNamespaceInUse(void)
+{
+	return OidIsValid(myTempNamespace);
+}
+
 /*
  * isTempToastNamespace - is the given namespace my temporary-toast-table
  *		namespace?
@@ -449,7 +449,9 @@ CREATE VIEW pg_stat_all_tables AS
             pg_stat_get_vacuum_count(C.oid) AS vacuum_count,
             pg_stat_get_autovacuum_count(C.oid) AS autovacuum_count,
             pg_stat_get_analyze_count(C.oid) AS analyze_count,
-            pg_stat_get_autoanalyze_count(C.oid) AS autoanalyze_count
+            pg_stat_get_autoanalyze_count(C.oid) AS autoanalyze_count,
+            pg_stat_get_ext_lock_waits(C.oid) AS ext_lock_waits,
+            pg_stat_get_prunes_deferred(C.oid) AS prunes_deferred
     FROM pg_class C LEFT JOIN
          pg_index I ON C.oid = I.indrelid
          LEFT JOIN pg_namespace N ON (N.oid = C.relnamespace)
@@ -621,6 +623,8 @@ CREATE VIEW pg_stat_activity AS
             S.query_start,
             S.state_change,
             S.waiting,
+            S.wait_event_type,
+            S.wait_event,
             S.state,
             S.backend_xid,
             s.backend_xmin,
@@ -629,6 +633,17 @@ CREATE VIEW pg_stat_activity AS
     WHERE S.datid = D.oid AND
             S.usesysid = U.oid;
 
+CREATE VIEW pg_stat_lwlocks AS
+    SELECT
+            S.name,
+            S.partition,
+            S.shared_acquire_count,
+            S.exclusive_acquire_count,
+            S.block_count,
+            S.wait_time,
+            S.spin_delay_count
+    FROM pg_stat_get_lwlocks() AS S;
+
 CREATE VIEW pg_stat_replication AS
     SELECT
             S.pid,
@@ -748,6 +763,46 @@ CREATE VIEW pg_stat_archiver AS
         s.stats_reset
     FROM pg_stat_get_archiver() s;
 
+CREATE VIEW pg_stat_recovery_prefetch AS
+    SELECT
+        s.prefetch,
+        s.hit,
+        s.skip_init,
+        s.skip_new,
+        s.skip_rep,
+        s.distance
+    FROM pg_stat_get_recovery_prefetch() s;
+
+CREATE VIEW pg_stat_catcache AS
+    SELECT
+        s.cacheid,
+        s.relid,
+        c.relname,
+        s.indexrelid,
+        s.entries,
+        s.searches,
+        s.hits,
+        s.neg_hits,
+        s.misses,
+        s.invalidations,
+        s.evictions
+    FROM pg_stat_get_catcache() s
+         LEFT JOIN pg_class c ON c.oid = s.relid;
+
+CREATE VIEW pg_stat_buffer_nodes AS
+    SELECT
+        s.partition,
+        s.node,
+        s.first_buffer,
+        s.buffers,
+        s.complete_passes,
+        s.allocs,
+        s.remote_allocs,
+        s.ring_allocs,
+        s.sweep_allocs,
+        s.dirty_allocs
+    FROM pg_stat_get_buffer_nodes() s;
+
 CREATE VIEW pg_stat_bgwriter AS
     SELECT
         pg_stat_get_bgwriter_timed_checkpoints() AS checkpoints_timed,
@@ -33,6 +33,7 @@
 #include "commands/vacuum.h"
 #include "executor/executor.h"
 #include "foreign/fdwapi.h"
+#include "lib/hyperloglog.h"
 #include "miscadmin.h"
 #include "nodes/nodeFuncs.h"
 #include "parser/parse_oper.h"
@@ -51,10 +52,12 @@
 #include "utils/memutils.h"
 #include "utils/pg_rusage.h"
 #include "utils/sampling.h"
+#include "utils/snapmgr.h"
 #include "utils/sortsupport.h"
 #include "utils/syscache.h"
 #include "utils/timestamp.h"
 #include "utils/tqual.h"
+#include "utils/typcache.h"
 
 
 /* Per-index data for ANALYZE */
@@ -64,12 +67,34 @@ typedef struct AnlIndexData
 	double		tupleFract;		/* fraction of rows for partial index */
 	VacAttrStats **vacattrstats;	/* index attrs to analyze */
 	int			attr_cnt;
+	int			group_ncols;	/* # of leading plain table columns */
+	VacAttrStats **groupstats;	/* stats of groups of those columns */
+	int			group_cnt;
 } AnlIndexData;
 
+/* Sort context for compute_index_group_stats */
+typedef struct
+{
+	int			ncols;			/* # of columns to sort on */
+	Datum	   *values;			/* ncols values per sample row */
+	bool	   *isnull;
+	SortSupport ssup;			/* one per column */
+} GroupSortContext;
+
 
 /* Default statistics target (GUC parameter) */
 int			default_statistics_target = 100;
 
+/* Whether to scan the whole table to estimate n_distinct (GUC parameter) */
+bool		analyze_full_ndistinct = false;
+
+/*
+ * Register width of the HyperLogLog sketches built by the full n_distinct
+ * scan.  2^14 one-byte registers per column give a standard error of about
+ * 1%.
+ */
+#define NDISTINCT_HLL_BWIDTH	14
+
 /* A few variables that don't seem worth passing around as parameters */
 static MemoryContext anl_context = NULL;
 static BufferAccessStrategy vac_strategy;
@@ -83,6 +108,13 @@ static void compute_index_stats(Relation onerel, double totalrows,
 					AnlIndexData *indexdata, int nindexes,
 					HeapTuple *rows, int numrows,
 					MemoryContext col_context);
+static void compute_index_group_stats(Relation onerel, Relation indexrel,
+						  double totalrows, AnlIndexData *thisdata,
+						  HeapTuple *rows, int numrows);
+static int	compare_group_rows(const void *a, const void *b, void *arg);
+static bool compute_full_ndistinct(Relation onerel,
+					   VacAttrStats **vacattrstats, int attr_cnt,
+					   double *ndistinct, double *scannedrows);
 static VacAttrStats *examine_attribute(Relation onerel, int attnum,
 				  Node *index_expr);
 static int acquire_sample_rows(Relation onerel, int elevel,
@@ -311,6 +343,8 @@ do_analyze_rel(Relation onerel, int options, VacuumParams *params,
 	PGRUsage	ru0;
 	TimestampTz starttime = 0;
 	MemoryContext caller_context;
+	double	   *full_ndistinct = NULL;
+	double		full_totalrows = 0;
 	Oid			save_userid;
 	int			save_sec_context;
 	int			save_nestlevel;
@@ -452,6 +486,21 @@ do_analyze_rel(Relation onerel, int options, VacuumParams *params,
 				}
 				thisdata->attr_cnt = tcnt;
 			}
+
+			/*
+			 * Also collect statistics about the group of table columns that
+			 * the index key starts with, if there's more than one; see
+			 * compute_index_group_stats.
+			 */
+			if (indexInfo->ii_Predicate == NIL && va_cols == NIL)
+			{
+				for (i = 0; i < indexInfo->ii_NumIndexKeyAttrs; i++)
+				{
+					if (indexInfo->ii_KeyAttrNumbers[i] <= 0)
+						break;
+				}
+				thisdata->group_ncols = i;
+			}
 		}
 	}
 
@@ -491,6 +540,22 @@ do_analyze_rel(Relation onerel, int options, VacuumParams *params,
 								  rows, targrows,
 								  &totalrows, &totaldeadrows);
 
+	/*
+	 * If asked to, read the whole table to estimate the number of distinct
+	 * values of each column, which a sample is notoriously bad at.
+	 */
+	if (analyze_full_ndistinct && !inh && numrows > 0 && attr_cnt > 0 &&
+		acquirefunc == acquire_sample_rows)
+	{
+		full_ndistinct = (double *) palloc(attr_cnt * sizeof(double));
+		if (!compute_full_ndistinct(onerel, vacattrstats, attr_cnt,
+									full_ndistinct, &full_totalrows))
+		{
+			pfree(full_ndistinct);
+			full_ndistinct = NULL;
+		}
+	}
+
 	/*
 	 * Compute the statistics.  Temporary results during the calculations for
 	 * each column are stored in a child context.  The calc routines are
@@ -521,6 +586,21 @@ do_analyze_rel(Relation onerel, int options, VacuumParams *params,
 									 numrows,
 									 totalrows);
 
+			/*
+			 * Prefer the number of distinct values counted by the full scan,
+			 * if we made one and have a count for this column.  A negative
+			 * count means the column's datatype can't be hashed.
+			 */
+			if (full_ndistinct != NULL && full_ndistinct[i] > 0 &&
+				stats->stats_valid)
+			{
+				double		stadistinct = floor(full_ndistinct[i] + 0.5);
+
+				if (stadistinct > 0.1 * full_totalrows)
+					stadistinct = -(stadistinct / full_totalrows);
+				stats->stadistinct = stadistinct;
+			}
+
 			/*
 			 * If the appropriate flavor of the n_distinct option is
 			 * specified, override with the corresponding value.
@@ -544,6 +624,15 @@ do_analyze_rel(Relation onerel, int options, VacuumParams *params,
 								rows, numrows,
 								col_context);
 
+		for (ind = 0; ind < nindexes; ind++)
+		{
+			if (indexdata[ind].group_ncols < 2)
+				continue;
+			compute_index_group_stats(onerel, Irel[ind], totalrows,
+									  &indexdata[ind], rows, numrows);
+			MemoryContextResetAndDeleteChildren(col_context);
+		}
+
 		MemoryContextSwitchTo(old_context);
 		MemoryContextDelete(col_context);
 
@@ -561,6 +650,8 @@ do_analyze_rel(Relation onerel, int options, VacuumParams *params,
 
 			update_attstats(RelationGetRelid(Irel[ind]), false,
 							thisdata->attr_cnt, thisdata->vacattrstats);
+			update_attstats(RelationGetRelid(Irel[ind]), false,
+							thisdata->group_cnt, thisdata->groupstats);
 		}
 	}
 
@@ -572,7 +663,7 @@ do_analyze_rel(Relation onerel, int options, VacuumParams *params,
 		vac_update_relstats(onerel,
 							relpages,
 							totalrows,
-							visibilitymap_count(onerel),
+							visibilitymap_count(onerel, NULL),
 							hasindex,
 							InvalidTransactionId,
 							InvalidMultiXactId,
@@ -840,6 +931,372 @@ compute_index_stats(Relation onerel, double totalrows,
 	MemoryContextDelete(ind_context);
 }
 
+/*
+ * compute_full_ndistinct() -- count distinct values by scanning the table
+ *
+ * Reads every tuple of the table visible to a fresh snapshot, feeding the
+ * hash of each non-null value of each column to a HyperLogLog sketch.  This
+ * costs a sequential scan, but unlike the estimate from the sample, it stays
+ * accurate however skewed the distribution or large the number of distinct
+ * values is.
+ *
+ * On return, ndistinct[i] holds the estimated number of distinct non-null
+ * values of the column of vacattrstats[i], or -1 if its datatype has no hash
+ * function, and *scannedrows the number of rows read.  Returns false if no
+ * column could be counted, or the table turned out to be empty.
+ */
+static bool
+compute_full_ndistinct(Relation onerel, VacAttrStats **vacattrstats,
+					   int attr_cnt, double *ndistinct, double *scannedrows)
+{
+	hyperLogLogState *sketches;
+	FmgrInfo  **hashfns;
+	int			natts = RelationGetNumberOfAttributes(onerel);
+	Datum	   *values;
+	bool	   *isnull;
+	MemoryContext tuple_context,
+				old_context;
+	Snapshot	snapshot;
+	HeapScanDesc scan;
+	HeapTuple	tuple;
+	double		nrows = 0;
+	bool		any = false;
+	int			i;
+
+	sketches = (hyperLogLogState *) palloc(attr_cnt * sizeof(hyperLogLogState));
+	hashfns = (FmgrInfo **) palloc(attr_cnt * sizeof(FmgrInfo *));
+	for (i = 0; i < attr_cnt; i++)
+	{
+		TypeCacheEntry *typentry;
+
+		typentry = lookup_type_cache(vacattrstats[i]->attrtypid,
+									 TYPECACHE_HASH_PROC_FINFO);
+		if (OidIsValid(typentry->hash_proc_finfo.fn_oid))
+		{
+			hashfns[i] = &typentry->hash_proc_finfo;
+			initHyperLogLog(&sketches[i], NDISTINCT_HLL_BWIDTH);
+			any = true;
+		}
+		else
+			hashfns[i] = NULL;
+	}
+	if (!any)
+		return false;
+
+	values = (Datum *) palloc(natts * sizeof(Datum));
+	isnull = (bool *) palloc(natts * sizeof(bool));
+
+	tuple_context = AllocSetContextCreate(CurrentMemoryContext,
+										  "Analyze full ndistinct",
+										  ALLOCSET_SMALL_MINSIZE,
+										  ALLOCSET_SMALL_INITSIZE,
+										  ALLOCSET_SMALL_MAXSIZE);
+
+	snapshot = RegisterSnapshot(GetTransactionSnapshot());
+	scan = heap_beginscan(onerel, snapshot, 0, NULL);
+
+	while ((tuple = heap_getnext(scan, ForwardScanDirection)) != NULL)
+	{
+		vacuum_delay_point();
+
+		old_context = MemoryContextSwitchTo(tuple_context);
+
+		heap_deform_tuple(tuple, RelationGetDescr(onerel), values, isnull);
+
+		for (i = 0; i < attr_cnt; i++)
+		{
+			VacAttrStats *stats = vacattrstats[i];
+			int			attoff = stats->tupattnum - 1;
+			Datum		hash;
+
+			if (hashfns[i] == NULL || isnull[attoff])
+				continue;
+
+			hash = FunctionCall1Coll(hashfns[i], stats->attr->attcollation,
+									 values[attoff]);
+			addHyperLogLog(&sketches[i], DatumGetUInt32(hash));
+		}
+		nrows += 1;
+
+		MemoryContextSwitchTo(old_context);
+		MemoryContextReset(tuple_context);
+	}
+
+	heap_endscan(scan);
+	UnregisterSnapshot(snapshot);
+	MemoryContextDelete(tuple_context);
+
+	for (i = 0; i < attr_cnt; i++)
+	{
+		if (hashfns[i] != NULL)
+		{
+			ndistinct[i] = estimateHyperLogLog(&sketches[i]);
+			if (ndistinct[i] > nrows)
+				ndistinct[i] = nrows;
+			pfree(sketches[i].hashesArr);
+		}
+		else
+			ndistinct[i] = -1;
+	}
+
+	pfree(sketches);
+	pfree(hashfns);
+	pfree(values);
+	pfree(isnull);
+
+	*scannedrows = nrows;
+
+	return nrows > 0;
+}
+
+/*
+ * Compute statistics about the group of table columns that an index key
+ * starts with
+ *
+ * The planner otherwise has to assume that the values of different columns
+ * are independent, which makes it badly underestimate how many rows match
+ * conditions on columns that are correlated, and overestimate how many
+ * groups of values there are.  The leading columns of a multi-column index
+ * are a good bet for columns that are used together in queries, so we keep
+ * statistics on them: for each prefix of the index key that is made of two
+ * or more plain table columns, the number of distinct combinations of their
+ * values, and the degree to which the last one is determined by the others.
+ * These are kept in the index's pg_statistic row for the last column of the
+ * prefix, as described at STATISTIC_KIND_DEPENDENCY.
+ *
+ * Everything comes from a single sort of the sample rows on all the leading
+ * plain columns: the rows that agree on any prefix of those columns are then
+ * adjacent, so a single pass over the sorted rows per prefix does the rest.
+ * NULLs are treated as equal to each other.
+ *
+ * Temporary data is allocated in the current memory context, which the caller
+ * is expected to reset; the results go into anl_context.
+ */
+static void
+compute_index_group_stats(Relation onerel, Relation indexrel,
+						  double totalrows, AnlIndexData *thisdata,
+						  HeapTuple *rows, int numrows)
+{
+	IndexInfo  *indexInfo = thisdata->indexInfo;
+	TupleDesc	tupdesc = RelationGetDescr(onerel);
+	GroupSortContext cxt;
+	int			ncols;
+	int		   *order;
+	int		   *diffpos;
+	int		   *firstnull;
+	double	   *colwidth;
+	double		totalwidth;
+	int			nullrows;
+	int			i,
+				j,
+				k;
+
+	/* we need a sort order for each column; stop at any that hasn't one */
+	cxt.ssup = (SortSupport) palloc0(thisdata->group_ncols *
+									 sizeof(SortSupportData));
+	for (ncols = 0; ncols < thisdata->group_ncols; ncols++)
+	{
+		Form_pg_attribute attr;
+		TypeCacheEntry *typentry;
+		SortSupport ssup = &cxt.ssup[ncols];
+
+		attr = tupdesc->attrs[indexInfo->ii_KeyAttrNumbers[ncols] - 1];
+		typentry = lookup_type_cache(attr->atttypid, TYPECACHE_LT_OPR);
+		if (!OidIsValid(typentry->lt_opr))
+			break;
+
+		ssup->ssup_cxt = CurrentMemoryContext;
+		ssup->ssup_collation = attr->attcollation;
+		ssup->ssup_nulls_first = false;
+		PrepareSortSupportFromOrderingOp(typentry->lt_opr, ssup);
+	}
+	if (ncols < 2)
+		return;
+
+	/* extract the values, and note each row's first NULL and widths */
+	cxt.ncols = ncols;
+	cxt.values = (Datum *) palloc(numrows * ncols * sizeof(Datum));
+	cxt.isnull = (bool *) palloc(numrows * ncols * sizeof(bool));
+	order = (int *) palloc(numrows * sizeof(int));
+	firstnull = (int *) palloc(numrows * sizeof(int));
+	colwidth = (double *) palloc0(ncols * sizeof(double));
+
+	for (i = 0; i < numrows; i++)
+	{
+		vacuum_delay_point();
+
+		order[i] = i;
+		firstnull[i] = ncols;
+		for (j = ncols - 1; j >= 0; j--)
+		{
+			int			attnum = indexInfo->ii_KeyAttrNumbers[j];
+			Form_pg_attribute attr = tupdesc->attrs[attnum - 1];
+			Datum		value;
+			bool		isnull;
+
+			value = heap_getattr(rows[i], attnum, tupdesc, &isnull);
+			cxt.values[i * ncols + j] = value;
+			cxt.isnull[i * ncols + j] = isnull;
+			if (isnull)
+				firstnull[i] = j;
+			else if (attr->attlen > 0)
+				colwidth[j] += attr->attlen;
+			else if (attr->attlen == -1)
+				colwidth[j] += VARSIZE_ANY(DatumGetPointer(value));
+			else
+				colwidth[j] += strlen(DatumGetCString(value)) + 1;
+		}
+	}
+
+	qsort_arg((void *) order, numrows, sizeof(int), compare_group_rows,
+			  (void *) &cxt);
+
+	/*
+	 * For each sorted row, find the first column in which it differs from the
+	 * previous one, or ncols if none.  The first row counts as differing in
+	 * column 0, so that it starts a group for every prefix.
+	 */
+	diffpos = (int *) palloc(numrows * sizeof(int));
+	diffpos[0] = 0;
+	for (i = 1; i < numrows; i++)
+	{
+		int			prev = order[i - 1] * ncols;
+		int			cur = order[i] * ncols;
+
+		for (j = 0; j < ncols; j++)
+		{
+			if (ApplySortComparator(cxt.values[prev + j],
+									cxt.isnull[prev + j],
+									cxt.values[cur + j],
+									cxt.isnull[cur + j],
+									&cxt.ssup[j]) != 0)
+				break;
+		}
+		diffpos[i] = j;
+	}
+
+	thisdata->groupstats = (VacAttrStats **)
+		MemoryContextAlloc(anl_context, (ncols - 1) * sizeof(VacAttrStats *));
+	thisdata->group_cnt = 0;
+
+	totalwidth = colwidth[0];
+	for (k = 2; k <= ncols; k++)
+	{
+		VacAttrStats *stats;
+		int			ndistinct = 0;
+		int			nsingle = 0;
+		int			groupsize = 0;
+		int			supporting = 0;
+		int			depgroupsize = 0;
+		bool		consistent = true;
+		double		stadistinct;
+
+		/*
+		 * Count the groups of rows that agree on the first k columns, and the
+		 * groups that agree on the first k - 1 and also all have the same
+		 * value in the kth one.
+		 */
+		for (i = 0; i < numrows; i++)
+		{
+			if (diffpos[i] < k)
+			{
+				if (groupsize == 1)
+					nsingle++;
+				ndistinct++;
+				groupsize = 0;
+			}
+			groupsize++;
+
+			if (diffpos[i] < k - 1)
+			{
+				if (consistent)
+					supporting += depgroupsize;
+				consistent = true;
+				depgroupsize = 0;
+			}
+			else if (diffpos[i] == k - 1)
+				consistent = false;
+			depgroupsize++;
+		}
+		if (groupsize == 1)
+			nsingle++;
+		if (consistent)
+			supporting += depgroupsize;
+
+		/* estimate the number of distinct groups as compute_scalar_stats does */
+		if (nsingle == numrows)
+			stadistinct = -1.0;
+		else
+		{
+			double		n = numrows;
+			double		f1 = nsingle;
+			double		denom;
+
+			denom = (n - f1) + f1 * n / totalrows;
+			stadistinct = (n * ndistinct) / denom;
+			if (stadistinct < ndistinct)
+				stadistinct = ndistinct;
+			if (stadistinct > totalrows)
+				stadistinct = totalrows;
+			stadistinct = floor(stadistinct + 0.5);
+			if (stadistinct > 0.1 * totalrows)
+				stadistinct = -(stadistinct / totalrows);
+		}
+
+		nullrows = 0;
+		for (i = 0; i < numrows; i++)
+		{
+			if (firstnull[i] < k)
+				nullrows++;
+		}
+		totalwidth += colwidth[k - 1];
+
+		stats = (VacAttrStats *) MemoryContextAllocZero(anl_context,
+														sizeof(VacAttrStats));
+		stats->attr = (Form_pg_attribute)
+			MemoryContextAlloc(anl_context, ATTRIBUTE_FIXED_PART_SIZE);
+		memcpy(stats->attr, indexrel->rd_att->attrs[k - 1],
+			   ATTRIBUTE_FIXED_PART_SIZE);
+		stats->stats_valid = true;
+		stats->stanullfrac = (double) nullrows / numrows;
+		stats->stawidth = totalwidth / numrows;
+		stats->stadistinct = stadistinct;
+		stats->stakind[0] = STATISTIC_KIND_DEPENDENCY;
+		stats->stanumbers[0] = (float4 *)
+			MemoryContextAlloc(anl_context, sizeof(float4));
+		stats->stanumbers[0][0] = (double) supporting / numrows;
+		stats->numnumbers[0] = 1;
+
+		thisdata->groupstats[thisdata->group_cnt++] = stats;
+	}
+}
+
+/*
+ * qsort_arg comparator for sorting sample rows in compute_index_group_stats
+ */
+static int
+compare_group_rows(const void *a, const void *b, void *arg)
+{
+	GroupSortContext *cxt = (GroupSortContext *) arg;
+	int			ra = *(const int *) a * cxt->ncols;
+	int			rb = *(const int *) b * cxt->ncols;
+	int			j;
+
+	for (j = 0; j < cxt->ncols; j++)
+	{
+		int			compare;
+
+		compare = ApplySortComparator(cxt->values[ra + j], cxt->isnull[ra + j],
+									  cxt->values[rb + j], cxt->isnull[rb + j],
+									  &cxt->ssup[j]);
+		if (compare != 0)
+			return compare;
+	}
+
+	/* keep the sort stable, for predictability */
+	return *(const int *) a - *(const int *) b;
+}
+
 /*
  * examine_attribute -- pre-analysis of a single column
  *
@@ -968,6 +1425,12 @@ examine_attribute(Relation onerel, int attnum, Node *index_expr)
  * unbiased estimates of the average numbers of live and dead rows per
  * block.  The previous sampling method put too much credence in the row
  * density near the start of the table.
+ *
+ * The sample blocks are scattered all over the table, so reading them one
+ * at a time would mean waiting for a random read each time.  When we can,
+ * we prefetch blocks up to target_prefetch_pages ahead of the one being
+ * read; a second copy of the block sampler, run ahead of the main one,
+ * tells us which blocks those are.
  */
 static int
 acquire_sample_rows(Relation onerel, int elevel,
@@ -983,6 +1446,10 @@ acquire_sample_rows(Relation onerel, int elevel,
 	TransactionId OldestXmin;
 	BlockSamplerData bs;
 	ReservoirStateData rstate;
+#ifdef USE_PREFETCH
+	BlockSamplerData prefetch_bs;
+	int			i;
+#endif
 
 	Assert(targrows > 0);
 
@@ -996,6 +1463,17 @@ acquire_sample_rows(Relation onerel, int elevel,
 	/* Prepare for sampling rows */
 	reservoir_init_selection_state(&rstate, targrows);
 
+#ifdef USE_PREFETCH
+	/* start prefetching the first blocks of the sample */
+	prefetch_bs = bs;
+	for (i = 0; i < target_prefetch_pages; i++)
+	{
+		if (!BlockSampler_HasMore(&prefetch_bs))
+			break;
+		PrefetchBuffer(onerel, MAIN_FORKNUM, BlockSampler_Next(&prefetch_bs));
+	}
+#endif
+
 	/* Outer loop over blocks to sample */
 	while (BlockSampler_HasMore(&bs))
 	{
@@ -1007,6 +1485,13 @@ acquire_sample_rows(Relation onerel, int elevel,
 
 		vacuum_delay_point();
 
+#ifdef USE_PREFETCH
+		/* keep the prefetch window moving along with us */
+		if (target_prefetch_pages > 0 && BlockSampler_HasMore(&prefetch_bs))
+			PrefetchBuffer(onerel, MAIN_FORKNUM,
+						   BlockSampler_Next(&prefetch_bs));
+#endif
+
 		/*
 		 * We must maintain a pin on the target page's buffer to ensure that
 		 * the maxoffset value stays good (else concurrent VACUUM might delete
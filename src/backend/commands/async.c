@@ -24,8 +24,11 @@
  *	  All notification messages are placed in the queue and later read out
  *	  by listening backends.
  *
- *	  There is no central knowledge of which backend listens on which channel;
- *	  every backend has its own list of interesting channels.
+ *	  There is no exact central knowledge of which backend listens on which
+ *	  channel; every backend has its own list of interesting channels.  But
+ *	  each listening backend advertises its database and a small filter
+ *	  summarizing its channels in shared memory, so that notifying backends
+ *	  can tell which listeners are surely not interested (see point 4).
  *
  *	  Although there is only one queue, notifications are treated as being
  *	  database-local; this is done by including the sender's database OID
@@ -54,7 +57,8 @@
  *	  on a 2 million row table fires a notification for each row that has been
  *	  changed. If the application needs to receive every single notification
  *	  that has been sent, it can easily add some unique string into the extra
- *	  payload parameter.
+ *	  payload parameter.  Once the list gets longer than a few entries, a hash
+ *	  table is used to find duplicates.
  *
  *	  When the transaction is ready to commit, PreCommit_Notify() adds the
  *	  pending notifications to the head of the queue. The head pointer of the
@@ -73,10 +77,14 @@
  *	  Finally, after we are out of the transaction altogether, we check if
  *	  we need to signal listening backends.  In SignalBackends() we scan the
  *	  list of listening backends and send a PROCSIG_NOTIFY_INTERRUPT signal
- *	  to every listening backend (we don't know which backend is listening on
- *	  which channel so we must signal them all). We can exclude backends that
- *	  are already up to date, though.  We don't bother with a self-signal
- *	  either, but just process the queue directly.
+ *	  to those that may be listening on one of the channels we notified, by
+ *	  comparing their channel filter with the filter of our channels.  We can
+ *	  exclude backends that are already up to date.  A backend that is surely
+ *	  not interested and has read the queue up to where our notifications
+ *	  start is simply moved past them, without waking it up; other
+ *	  uninterested backends are only signalled once they fall too far behind,
+ *	  so that they don't keep the queue from being truncated.  We don't
+ *	  bother with a self-signal either, but just process the queue directly.
  *
  * 5. Upon receipt of a PROCSIG_NOTIFY_INTERRUPT signal, the signal handler
  *	  sets the process's latch, which triggers the event to be processed
@@ -104,7 +112,7 @@
  * frontend during startup.)  The above design guarantees that notifies from
  * other backends will never be missed by ignoring self-notifies.
  *
- * The amount of shared memory used for notify management (NUM_ASYNC_BUFFERS)
+ * The amount of shared memory used for notify management (notify_buffers)
  * can be varied without affecting anything but performance.  The maximum
  * amount of notification data that can be queued at one time is determined
  * by slru.c's wraparound limit; see QUEUE_MAX_PAGE below.
@@ -117,6 +125,7 @@
 #include <unistd.h>
 #include <signal.h>
 
+#include "access/hash.h"
 #include "access/slru.h"
 #include "access/transam.h"
 #include "access/xact.h"
@@ -202,12 +211,26 @@ typedef struct QueuePosition
 	 (x).page != (y).page ? (y) : \
 	 (x).offset < (y).offset ? (x) : (y))
 
+/*
+ * A channel filter is a tiny Bloom filter of channel names: each channel
+ * sets CHANNEL_FILTER_NHASHES bits, and a filter with any of a channel's
+ * bits clear surely doesn't include that channel.
+ */
+typedef uint64 ChannelFilter;
+
+#define CHANNEL_FILTER_NHASHES		2
+
 /*
  * Struct describing a listening backend's status
+ *
+ * The filter includes all channels the backend listens on, and possibly
+ * more; it is only ever cleared of channels after they have been unlistened.
  */
 typedef struct QueueBackendStatus
 {
 	int32		pid;			/* either a PID or InvalidPid */
+	Oid			dboid;			/* backend's database OID */
+	ChannelFilter filter;		/* channels the backend listens on */
 	QueuePosition pos;			/* backend has read queue up to here */
 } QueueBackendStatus;
 
@@ -246,6 +269,8 @@ static AsyncQueueControl *asyncQueueControl;
 #define QUEUE_HEAD					(asyncQueueControl->head)
 #define QUEUE_TAIL					(asyncQueueControl->tail)
 #define QUEUE_BACKEND_PID(i)		(asyncQueueControl->backend[i].pid)
+#define QUEUE_BACKEND_DBOID(i)		(asyncQueueControl->backend[i].dboid)
+#define QUEUE_BACKEND_FILTER(i)		(asyncQueueControl->backend[i].filter)
 #define QUEUE_BACKEND_POS(i)		(asyncQueueControl->backend[i].pos)
 
 /*
@@ -276,6 +301,13 @@ static SlruCtlData AsyncCtlData;
  */
 #define QUEUE_MAX_PAGE			(SLRU_PAGES_PER_SEGMENT * 0x10000 - 1)
 
+/*
+ * A listening backend that isn't interested in the notifications being sent
+ * is signalled anyway once it is this many pages behind the queue head, so
+ * that it advances its position and lets the queue be truncated.
+ */
+#define QUEUE_CLEANUP_DELAY		4
+
 /*
  * listenChannels identifies the channels we are actually listening to
  * (ie, have committed a LISTEN on).  It is a simple list of channel names,
@@ -313,7 +345,7 @@ static List *upperPendingActions = NIL; /* list of upper-xact lists */
 /*
  * State for outbound notifies consists of a list of all channels+payloads
  * NOTIFYed in the current transaction. We do not actually perform a NOTIFY
- * until and unless the transaction commits.  pendingNotifies is NIL if no
+ * until and unless the transaction commits.  pendingNotifies is NULL if no
  * NOTIFYs have been done in the current transaction.
  *
  * The list is kept in CurTransactionContext.  In subtransactions, each
@@ -325,6 +357,10 @@ static List *upperPendingActions = NIL; /* list of upper-xact lists */
  * In particular, if a transaction does NOTIFY and then LISTEN on the same
  * condition name, it will get a self-notify at commit.  This is a bit odd
  * but is consistent with our historical behavior.
+ *
+ * Once a list has MIN_HASHABLE_NOTIFIES entries, a hash table of them is
+ * built to make duplicate elimination cheap; it's kept in the same memory
+ * context as the list.
  */
 typedef struct Notification
 {
@@ -332,7 +368,20 @@ typedef struct Notification
 	char	   *payload;		/* payload string (can be empty) */
 } Notification;
 
-static List *pendingNotifies = NIL;		/* list of Notifications */
+typedef struct NotificationList
+{
+	List	   *events;			/* list of Notifications */
+	HTAB	   *hashtab;		/* hash of Notifications, or NULL */
+} NotificationList;
+
+#define MIN_HASHABLE_NOTIFIES	16
+
+typedef struct NotificationHashEntry
+{
+	Notification *event;		/* hash key: the event itself */
+} NotificationHashEntry;
+
+static NotificationList *pendingNotifies = NULL;	/* current list, or NULL */
 
 static List *upperPendingNotifies = NIL;		/* list of upper-xact lists */
 
@@ -354,11 +403,23 @@ static bool amRegisteredListener = false;
 /* has this backend sent notifications in the current transaction? */
 static bool backendHasSentNotifications = false;
 
-/* GUC parameter */
+/*
+ * Where the notifications we sent start and end in the queue, and a filter
+ * of their channels; valid if backendHasSentNotifications.
+ */
+static QueuePosition sentNotifiesStart;
+static QueuePosition sentNotifiesEnd;
+static ChannelFilter sentNotifiesFilter;
+
+/* GUC parameters */
 bool		Trace_notify = false;
+int			notify_buffers = 8;
 
 /* local function prototypes */
+static int	asyncQueuePageDiff(int p, int q);
 static bool asyncQueuePagePrecedes(int p, int q);
+static ChannelFilter ChannelFilterFor(const char *channel);
+static void asyncQueueUpdateFilter(ChannelFilter filter, bool add);
 static void queue_listen(ListenActionKind action, const char *channel);
 static void Async_UnlistenOnExit(int code, Datum arg);
 static void Exec_ListenPreCommit(void);
@@ -369,8 +430,10 @@ static bool IsListeningOn(const char *channel);
 static void asyncQueueUnregister(void);
 static bool asyncQueueIsFull(void);
 static bool asyncQueueAdvance(volatile QueuePosition *position, int entryLength);
-static void asyncQueueNotificationToEntry(Notification *n, AsyncQueueEntry *qe);
-static ListCell *asyncQueueAddEntries(ListCell *nextNotify);
+static void asyncQueueNotificationToEntry(Notification *n, TransactionId xid,
+							  int entryLength, AsyncQueueEntry *qe);
+static int	asyncQueueEntryLength(Notification *n);
+static ListCell *asyncQueueAddEntries(ListCell *nextNotify, TransactionId xid);
 static void asyncQueueFillWarning(void);
 static bool SignalBackends(void);
 static void asyncQueueReadAllNotifications(void);
@@ -383,13 +446,21 @@ static void NotifyMyFrontEnd(const char *channel,
 				 const char *payload,
 				 int32 srcPid);
 static bool AsyncExistsPendingNotify(const char *channel, const char *payload);
+static void AddEventToPendingNotifies(NotificationList *notifies,
+						  Notification *n);
+static uint32 notification_hash(const void *key, Size keysize);
+static int	notification_match(const void *key1, const void *key2,
+				   Size keysize);
 static void ClearPendingActionsAndNotifies(void);
 
 /*
  * We will work on the page range of 0..QUEUE_MAX_PAGE.
+ *
+ * asyncQueuePageDiff returns the number of pages p is ahead of q, which is
+ * negative if p logically precedes q.
  */
-static bool
-asyncQueuePagePrecedes(int p, int q)
+static int
+asyncQueuePageDiff(int p, int q)
 {
 	int			diff;
 
@@ -405,7 +476,33 @@ asyncQueuePagePrecedes(int p, int q)
 		diff -= QUEUE_MAX_PAGE + 1;
 	else if (diff < -((QUEUE_MAX_PAGE + 1) / 2))
 		diff += QUEUE_MAX_PAGE + 1;
-	return diff < 0;
+	return diff;
+}
+
+static bool
+asyncQueuePagePrecedes(int p, int q)
+{
+	return asyncQueuePageDiff(p, q) < 0;
+}
+
+/*
+ * Compute the channel filter containing just the given channel.
+ */
+static ChannelFilter
+ChannelFilterFor(const char *channel)
+{
+	uint32		hash;
+	ChannelFilter filter = 0;
+	int			i;
+
+	hash = DatumGetUInt32(hash_any_fast((const unsigned char *) channel,
+										strlen(channel)));
+
+	/* use a different 6-bit slice of the hash for each bit */
+	for (i = 0; i < CHANNEL_FILTER_NHASHES; i++)
+		filter |= UINT64CONST(1) << ((hash >> (i * 6)) & 63);
+
+	return filter;
 }
 
 /*
@@ -420,7 +517,7 @@ AsyncShmemSize(void)
 	size = mul_size(MaxBackends + 1, sizeof(QueueBackendStatus));
 	size = add_size(size, offsetof(AsyncQueueControl, backend));
 
-	size = add_size(size, SimpleLruShmemSize(NUM_ASYNC_BUFFERS, 0));
+	size = add_size(size, SimpleLruShmemSize(notify_buffers, 0));
 
 	return size;
 }
@@ -459,6 +556,8 @@ AsyncShmemInit(void)
 		for (i = 0; i <= MaxBackends; i++)
 		{
 			QUEUE_BACKEND_PID(i) = InvalidPid;
+			QUEUE_BACKEND_DBOID(i) = InvalidOid;
+			QUEUE_BACKEND_FILTER(i) = 0;
 			SET_QUEUE_POS(QUEUE_BACKEND_POS(i), 0, 0);
 		}
 	}
@@ -467,7 +566,7 @@ AsyncShmemInit(void)
 	 * Set up SLRU management of the pg_notify data.
 	 */
 	AsyncCtl->PagePrecedes = asyncQueuePagePrecedes;
-	SimpleLruInit(AsyncCtl, "Async Ctl", NUM_ASYNC_BUFFERS, 0,
+	SimpleLruInit(AsyncCtl, "Async Ctl", notify_buffers, 0,
 				  AsyncCtlLock, "pg_notify");
 	/* Override default assumption that writes should be fsync'd */
 	AsyncCtl->do_fsync = false;
@@ -572,11 +671,18 @@ Async_Notify(const char *channel, const char *payload)
 	else
 		n->payload = "";
 
+	if (pendingNotifies == NULL)
+	{
+		pendingNotifies = (NotificationList *) palloc(sizeof(NotificationList));
+		pendingNotifies->events = NIL;
+		pendingNotifies->hashtab = NULL;
+	}
+
 	/*
 	 * We want to preserve the order so we need to append every notification.
 	 * See comments at AsyncExistsPendingNotify().
 	 */
-	pendingNotifies = lappend(pendingNotifies, n);
+	AddEventToPendingNotifies(pendingNotifies, n);
 
 	MemoryContextSwitchTo(oldcontext);
 }
@@ -735,7 +841,7 @@ void
 AtPrepare_Notify(void)
 {
 	/* It's not allowed to have any pending LISTEN/UNLISTEN/NOTIFY actions */
-	if (pendingActions || pendingNotifies)
+	if (pendingActions || pendingNotifies != NULL)
 		ereport(ERROR,
 				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
 				 errmsg("cannot PREPARE a transaction that has executed LISTEN, UNLISTEN, or NOTIFY")));
@@ -761,7 +867,7 @@ PreCommit_Notify(void)
 {
 	ListCell   *p;
 
-	if (pendingActions == NIL && pendingNotifies == NIL)
+	if (pendingActions == NIL && pendingNotifies == NULL)
 		return;					/* no relevant statements in this xact */
 
 	if (Trace_notify)
@@ -776,6 +882,13 @@ PreCommit_Notify(void)
 		{
 			case LISTEN_LISTEN:
 				Exec_ListenPreCommit();
+
+				/*
+				 * Advertise the channel before we commit, so that anyone
+				 * sending to it after our commit will signal us.
+				 */
+				asyncQueueUpdateFilter(ChannelFilterFor(actrec->channel),
+									   true);
 				break;
 			case LISTEN_UNLISTEN:
 				/* there is no Exec_UnlistenPreCommit() */
@@ -787,9 +900,10 @@ PreCommit_Notify(void)
 	}
 
 	/* Queue any pending notifies */
-	if (pendingNotifies)
+	if (pendingNotifies != NULL)
 	{
 		ListCell   *nextNotify;
+		TransactionId xid;
 
 		/*
 		 * Make sure that we have an XID assigned to the current transaction.
@@ -797,7 +911,16 @@ PreCommit_Notify(void)
 		 * so cheap if we don't, and we'd prefer not to do that work while
 		 * holding AsyncQueueLock.
 		 */
-		(void) GetCurrentTransactionId();
+		xid = GetCurrentTransactionId();
+
+		/* Summarize our channels for SignalBackends, likewise */
+		sentNotifiesFilter = 0;
+		foreach(p, pendingNotifies->events)
+		{
+			Notification *n = (Notification *) lfirst(p);
+
+			sentNotifiesFilter |= ChannelFilterFor(n->channel);
+		}
 
 		/*
 		 * Serialize writers by acquiring a special lock that we hold till
@@ -821,7 +944,7 @@ PreCommit_Notify(void)
 		/* Now push the notifications into the queue */
 		backendHasSentNotifications = true;
 
-		nextNotify = list_head(pendingNotifies);
+		nextNotify = list_head(pendingNotifies->events);
 		while (nextNotify != NULL)
 		{
 			/*
@@ -829,6 +952,10 @@ PreCommit_Notify(void)
 			 * release AsyncQueueLock once per page, which might be overkill
 			 * but it does allow readers to get in while we're doing this.
 			 *
+			 * As the lock taken above keeps other backends from adding to
+			 * the queue until we have committed, our notifications end up
+			 * contiguous in the queue; remember where they are.
+			 *
 			 * A full queue is very uncommon and should really not happen,
 			 * given that we have so much space available in the SLRU pages.
 			 * Nevertheless we need to deal with this possibility. Note that
@@ -837,12 +964,15 @@ PreCommit_Notify(void)
 			 * point in time we can still roll the transaction back.
 			 */
 			LWLockAcquire(AsyncQueueLock, LW_EXCLUSIVE);
+			if (nextNotify == list_head(pendingNotifies->events))
+				sentNotifiesStart = QUEUE_HEAD;
 			asyncQueueFillWarning();
 			if (asyncQueueIsFull())
 				ereport(ERROR,
 						(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
 					  errmsg("too many notifications in the NOTIFY queue")));
-			nextNotify = asyncQueueAddEntries(nextNotify);
+			nextNotify = asyncQueueAddEntries(nextNotify, xid);
+			sentNotifiesEnd = QUEUE_HEAD;
 			LWLockRelease(AsyncQueueLock);
 		}
 	}
@@ -864,7 +994,7 @@ AtCommit_Notify(void)
 	 * Allow transactions that have not executed LISTEN/UNLISTEN/NOTIFY to
 	 * return as soon as possible
 	 */
-	if (!pendingActions && !pendingNotifies)
+	if (!pendingActions && pendingNotifies == NULL)
 		return;
 
 	if (Trace_notify)
@@ -892,11 +1022,38 @@ AtCommit_Notify(void)
 	/* If no longer listening to anything, get out of listener array */
 	if (amRegisteredListener && listenChannels == NIL)
 		asyncQueueUnregister();
+	else if (amRegisteredListener && pendingActions != NIL)
+	{
+		ChannelFilter filter = 0;
+
+		/* Stop advertising channels we no longer listen on */
+		foreach(p, listenChannels)
+			filter |= ChannelFilterFor((char *) lfirst(p));
+		asyncQueueUpdateFilter(filter, false);
+	}
 
 	/* And clean up */
 	ClearPendingActionsAndNotifies();
 }
 
+/*
+ * Set (add = false) or add to (add = true) our channel filter in the
+ * listener array.
+ */
+static void
+asyncQueueUpdateFilter(ChannelFilter filter, bool add)
+{
+	Assert(amRegisteredListener);
+
+	/* We may update our own entry while holding only shared lock */
+	LWLockAcquire(AsyncQueueLock, LW_SHARED);
+	if (add)
+		QUEUE_BACKEND_FILTER(MyBackendId) |= filter;
+	else
+		QUEUE_BACKEND_FILTER(MyBackendId) = filter;
+	LWLockRelease(AsyncQueueLock);
+}
+
 /*
  * Exec_ListenPreCommit --- subroutine for PreCommit_Notify
  *
@@ -935,6 +1092,8 @@ Exec_ListenPreCommit(void)
 	 */
 	LWLockAcquire(AsyncQueueLock, LW_SHARED);
 	QUEUE_BACKEND_POS(MyBackendId) = QUEUE_TAIL;
+	QUEUE_BACKEND_DBOID(MyBackendId) = MyDatabaseId;
+	QUEUE_BACKEND_FILTER(MyBackendId) = 0;
 	QUEUE_BACKEND_PID(MyBackendId) = MyProcPid;
 	LWLockRelease(AsyncQueueLock);
 
@@ -1030,6 +1189,17 @@ Exec_UnlistenAllCommit(void)
 	listenChannels = NIL;
 }
 
+/*
+ * IsListeningOnAnyChannel --- has this backend executed LISTEN?
+ *
+ * This reflects only committed LISTEN/UNLISTEN commands.
+ */
+bool
+IsListeningOnAnyChannel(void)
+{
+	return listenChannels != NIL;
+}
+
 /*
  * ProcessCompletedNotifies --- send out signals and self-notifies
  *
@@ -1055,7 +1225,6 @@ void
 ProcessCompletedNotifies(void)
 {
 	MemoryContext caller_context;
-	bool		signalled;
 
 	/* Nothing to do if we didn't send any notifications */
 	if (!backendHasSentNotifications)
@@ -1084,22 +1253,23 @@ ProcessCompletedNotifies(void)
 	StartTransactionCommand();
 
 	/* Send signals to other backends */
-	signalled = SignalBackends();
+	(void) SignalBackends();
 
 	if (listenChannels != NIL)
 	{
 		/* Read the queue ourselves, and send relevant stuff to the frontend */
 		asyncQueueReadAllNotifications();
 	}
-	else if (!signalled)
+	else
 	{
 		/*
-		 * If we found no other listening backends, and we aren't listening
-		 * ourselves, then we must execute asyncQueueAdvanceTail to flush the
-		 * queue, because ain't nobody else gonna do it.  This prevents queue
-		 * overflow when we're sending useless notifies to nobody. (A new
-		 * listener could have joined since we looked, but if so this is
-		 * harmless.)
+		 * If we aren't listening ourselves, then we must execute
+		 * asyncQueueAdvanceTail to flush the queue, because unless we
+		 * signalled the laziest listener, ain't nobody else gonna do it.
+		 * This prevents queue overflow when we're sending useless notifies
+		 * to nobody, or only to listeners whose positions SignalBackends
+		 * moved past them. (A new listener could have joined since we
+		 * looked, but if so this is harmless.)
 		 */
 		asyncQueueAdvanceTail();
 	}
@@ -1233,29 +1403,40 @@ asyncQueueAdvance(volatile QueuePosition *position, int entryLength)
 }
 
 /*
- * Fill the AsyncQueueEntry at *qe with an outbound notification message.
+ * Fill the AsyncQueueEntry at *qe with an outbound notification message,
+ * which takes entryLength bytes (see asyncQueueEntryLength).
  */
 static void
-asyncQueueNotificationToEntry(Notification *n, AsyncQueueEntry *qe)
+asyncQueueNotificationToEntry(Notification *n, TransactionId xid,
+							  int entryLength, AsyncQueueEntry *qe)
 {
 	size_t		channellen = strlen(n->channel);
 	size_t		payloadlen = strlen(n->payload);
-	int			entryLength;
 
-	Assert(channellen < NAMEDATALEN);
-	Assert(payloadlen < NOTIFY_PAYLOAD_MAX_LENGTH);
-
-	/* The terminators are already included in AsyncQueueEntryEmptySize */
-	entryLength = AsyncQueueEntryEmptySize + payloadlen + channellen;
-	entryLength = QUEUEALIGN(entryLength);
 	qe->length = entryLength;
 	qe->dboid = MyDatabaseId;
-	qe->xid = GetCurrentTransactionId();
+	qe->xid = xid;
 	qe->srcPid = MyProcPid;
 	memcpy(qe->data, n->channel, channellen + 1);
 	memcpy(qe->data + channellen + 1, n->payload, payloadlen + 1);
 }
 
+/*
+ * Compute the length of the queue entry for a notification.
+ */
+static int
+asyncQueueEntryLength(Notification *n)
+{
+	size_t		channellen = strlen(n->channel);
+	size_t		payloadlen = strlen(n->payload);
+
+	Assert(channellen < NAMEDATALEN);
+	Assert(payloadlen < NOTIFY_PAYLOAD_MAX_LENGTH);
+
+	/* The terminators are already included in AsyncQueueEntryEmptySize */
+	return QUEUEALIGN(AsyncQueueEntryEmptySize + payloadlen + channellen);
+}
+
 /*
  * Add pending notifications to the queue.
  *
@@ -1267,15 +1448,20 @@ asyncQueueNotificationToEntry(Notification *n, AsyncQueueEntry *qe)
  *
  * We are passed the list cell containing the next notification to write
  * and return the first still-unwritten cell back.  Eventually we will return
- * NULL indicating all is done.
+ * NULL indicating all is done.  xid is our transaction's XID.
+ *
+ * Entries are built right in the shared page buffer, rather than being
+ * copied there from a local one; nobody reads past QUEUE_HEAD, so nobody
+ * looks at them until we're done.
  *
  * We are holding AsyncQueueLock already from the caller and grab AsyncCtlLock
  * locally in this function.
  */
 static ListCell *
-asyncQueueAddEntries(ListCell *nextNotify)
+asyncQueueAddEntries(ListCell *nextNotify, TransactionId xid)
 {
-	AsyncQueueEntry qe;
+	AsyncQueueEntry *qe;
+	int			entryLength;
 	QueuePosition queue_head;
 	int			pageno;
 	int			offset;
@@ -1307,15 +1493,18 @@ asyncQueueAddEntries(ListCell *nextNotify)
 	{
 		Notification *n = (Notification *) lfirst(nextNotify);
 
-		/* Construct a valid queue entry in local variable qe */
-		asyncQueueNotificationToEntry(n, &qe);
-
 		offset = QUEUE_POS_OFFSET(queue_head);
+		qe = (AsyncQueueEntry *) (AsyncCtl->shared->page_buffer[slotno] +
+								  offset);
+		entryLength = asyncQueueEntryLength(n);
 
 		/* Check whether the entry really fits on the current page */
-		if (offset + qe.length <= QUEUE_PAGESIZE)
+		if (offset + entryLength <= QUEUE_PAGESIZE)
 		{
-			/* OK, so advance nextNotify past this item */
+			/* OK, so construct the queue entry in place */
+			asyncQueueNotificationToEntry(n, xid, entryLength, qe);
+
+			/* and advance nextNotify past this item */
 			nextNotify = lnext(nextNotify);
 		}
 		else
@@ -1323,21 +1512,20 @@ asyncQueueAddEntries(ListCell *nextNotify)
 			/*
 			 * Write a dummy entry to fill up the page. Actually readers will
 			 * only check dboid and since it won't match any reader's database
-			 * OID, they will ignore this entry and move on.
+			 * OID, they will ignore this entry and move on.  (There's always
+			 * room for its header and empty strings; see asyncQueueAdvance.)
 			 */
-			qe.length = QUEUE_PAGESIZE - offset;
-			qe.dboid = InvalidOid;
-			qe.data[0] = '\0';	/* empty channel */
-			qe.data[1] = '\0';	/* empty payload */
+			entryLength = QUEUE_PAGESIZE - offset;
+			qe->length = entryLength;
+			qe->dboid = InvalidOid;
+			qe->xid = xid;
+			qe->srcPid = MyProcPid;
+			qe->data[0] = '\0';	/* empty channel */
+			qe->data[1] = '\0';	/* empty payload */
 		}
 
-		/* Now copy qe into the shared buffer page */
-		memcpy(AsyncCtl->shared->page_buffer[slotno] + offset,
-			   &qe,
-			   qe.length);
-
 		/* Advance queue_head appropriately, and detect if page is full */
-		if (asyncQueueAdvance(&(queue_head), qe.length))
+		if (asyncQueueAdvance(&(queue_head), entryLength))
 		{
 			/*
 			 * Page is full, so we're done here, but first fill the next page
@@ -1427,7 +1615,8 @@ asyncQueueFillWarning(void)
 }
 
 /*
- * Send signals to all listening backends (except our own).
+ * Send signals to the listening backends (except our own) that may be
+ * interested in the notifications we just sent.
  *
  * Returns true if we sent at least one signal.
  *
@@ -1437,6 +1626,14 @@ asyncQueueFillWarning(void)
  * the signaled backend has read the other notifications and ours in the same
  * step.
  *
+ * A backend of another database, or whose channel filter rules out all our
+ * channels, isn't interested.  If it has read everything up to our
+ * notifications, we just move its position past them, which is exactly what
+ * it would do itself; else we only signal it if it has fallen more than
+ * QUEUE_CLEANUP_DELAY pages behind.  Anybody listening on one of our channels
+ * committed that before we committed, since it advertises its channels
+ * before commit, so we cannot miss it.
+ *
  * Since we know the BackendId and the Pid the signalling is quite cheap.
  */
 static bool
@@ -1470,12 +1667,27 @@ SignalBackends(void)
 		{
 			QueuePosition pos = QUEUE_BACKEND_POS(i);
 
-			if (!QUEUE_POS_EQUAL(pos, QUEUE_HEAD))
+			if (QUEUE_POS_EQUAL(pos, QUEUE_HEAD))
+				continue;
+
+			if (QUEUE_BACKEND_DBOID(i) != MyDatabaseId ||
+				(QUEUE_BACKEND_FILTER(i) & sentNotifiesFilter) == 0)
 			{
-				pids[count] = pid;
-				ids[count] = i;
-				count++;
+				/* not interested in our notifications */
+				if (QUEUE_POS_EQUAL(pos, sentNotifiesStart))
+				{
+					QUEUE_BACKEND_POS(i) = sentNotifiesEnd;
+					continue;
+				}
+				if (asyncQueuePageDiff(QUEUE_POS_PAGE(QUEUE_HEAD),
+									   QUEUE_POS_PAGE(pos)) <
+					QUEUE_CLEANUP_DELAY)
+					continue;
 			}
+
+			pids[count] = pid;
+			ids[count] = i;
+			count++;
 		}
 	}
 	LWLockRelease(AsyncQueueLock);
@@ -1551,7 +1763,7 @@ AtSubStart_Notify(void)
 	Assert(list_length(upperPendingNotifies) ==
 		   GetCurrentTransactionNestLevel() - 1);
 
-	pendingNotifies = NIL;
+	pendingNotifies = NULL;
 
 	MemoryContextSwitchTo(old_cxt);
 }
@@ -1565,7 +1777,7 @@ void
 AtSubCommit_Notify(void)
 {
 	List	   *parentPendingActions;
-	List	   *parentPendingNotifies;
+	NotificationList *parentPendingNotifies;
 
 	parentPendingActions = (List *) linitial(upperPendingActions);
 	upperPendingActions = list_delete_first(upperPendingActions);
@@ -1578,7 +1790,7 @@ AtSubCommit_Notify(void)
 	 */
 	pendingActions = list_concat(parentPendingActions, pendingActions);
 
-	parentPendingNotifies = (List *) linitial(upperPendingNotifies);
+	parentPendingNotifies = (NotificationList *) linitial(upperPendingNotifies);
 	upperPendingNotifies = list_delete_first(upperPendingNotifies);
 
 	Assert(list_length(upperPendingNotifies) ==
@@ -1586,8 +1798,24 @@ AtSubCommit_Notify(void)
 
 	/*
 	 * We could try to eliminate duplicates here, but it seems not worthwhile.
+	 * Our events go into the parent's hash table if it has one, though, so
+	 * that it stays complete.
 	 */
-	pendingNotifies = list_concat(parentPendingNotifies, pendingNotifies);
+	if (pendingNotifies == NULL)
+		pendingNotifies = parentPendingNotifies;
+	else if (parentPendingNotifies != NULL)
+	{
+		MemoryContext old_cxt;
+		ListCell   *l;
+
+		/* Our CurTransactionContext lives as long as the parent's lists */
+		old_cxt = MemoryContextSwitchTo(CurTransactionContext);
+		foreach(l, pendingNotifies->events)
+			AddEventToPendingNotifies(parentPendingNotifies,
+									  (Notification *) lfirst(l));
+		MemoryContextSwitchTo(old_cxt);
+		pendingNotifies = parentPendingNotifies;
+	}
 }
 
 /*
@@ -1616,7 +1844,7 @@ AtSubAbort_Notify(void)
 
 	while (list_length(upperPendingNotifies) > my_level - 2)
 	{
-		pendingNotifies = (List *) linitial(upperPendingNotifies);
+		pendingNotifies = (NotificationList *) linitial(upperPendingNotifies);
 		upperPendingNotifies = list_delete_first(upperPendingNotifies);
 	}
 }
@@ -2035,12 +2263,24 @@ AsyncExistsPendingNotify(const char *channel, const char *payload)
 	ListCell   *p;
 	Notification *n;
 
-	if (pendingNotifies == NIL)
+	if (pendingNotifies == NULL)
 		return false;
 
 	if (payload == NULL)
 		payload = "";
 
+	/* Long lists have a hash table, so just look there */
+	if (pendingNotifies->hashtab != NULL)
+	{
+		Notification key;
+		Notification *keyp = &key;
+
+		key.channel = (char *) channel;
+		key.payload = (char *) payload;
+		return hash_search(pendingNotifies->hashtab, &keyp,
+						   HASH_FIND, NULL) != NULL;
+	}
+
 	/*----------
 	 * We need to append new elements to the end of the list in order to keep
 	 * the order. However, on the other hand we'd like to check the list
@@ -2059,12 +2299,12 @@ AsyncExistsPendingNotify(const char *channel, const char *payload)
 	 * commit;
 	 *----------
 	 */
-	n = (Notification *) llast(pendingNotifies);
+	n = (Notification *) llast(pendingNotifies->events);
 	if (strcmp(n->channel, channel) == 0 &&
 		strcmp(n->payload, payload) == 0)
 		return true;
 
-	foreach(p, pendingNotifies)
+	foreach(p, pendingNotifies->events)
 	{
 		n = (Notification *) lfirst(p);
 
@@ -2076,6 +2316,87 @@ AsyncExistsPendingNotify(const char *channel, const char *payload)
 	return false;
 }
 
+/*
+ * Append a notification to a NotificationList, and enter it into the list's
+ * hash table, building that if the list just got long enough.
+ *
+ * The caller must have made sure the notification isn't a duplicate, if
+ * that matters.  The hash table is built in CurTransactionContext, which
+ * lasts as long as the list.
+ */
+static void
+AddEventToPendingNotifies(NotificationList *notifies, Notification *n)
+{
+	notifies->events = lappend(notifies->events, n);
+
+	if (notifies->hashtab == NULL &&
+		list_length(notifies->events) >= MIN_HASHABLE_NOTIFIES)
+	{
+		HASHCTL		hash_ctl;
+		ListCell   *l;
+
+		MemSet(&hash_ctl, 0, sizeof(hash_ctl));
+		hash_ctl.keysize = sizeof(Notification *);
+		hash_ctl.entrysize = sizeof(NotificationHashEntry);
+		hash_ctl.hash = notification_hash;
+		hash_ctl.match = notification_match;
+		hash_ctl.hcxt = CurTransactionContext;
+
+		notifies->hashtab =
+			hash_create("Pending Notifies",
+						256L,
+						&hash_ctl,
+						HASH_ELEM | HASH_FUNCTION | HASH_COMPARE |
+						HASH_CONTEXT);
+
+		/* Enter all the events, including the new one */
+		foreach(l, notifies->events)
+		{
+			Notification *oldn = (Notification *) lfirst(l);
+
+			(void) hash_search(notifies->hashtab, &oldn, HASH_ENTER, NULL);
+		}
+	}
+	else if (notifies->hashtab != NULL)
+		(void) hash_search(notifies->hashtab, &n, HASH_ENTER, NULL);
+}
+
+/*
+ * notification_hash: hash function for pending notifies hash tables
+ *
+ * The key is a pointer to a Notification.
+ */
+static uint32
+notification_hash(const void *key, Size keysize)
+{
+	const Notification *n = *(const Notification *const *) key;
+	uint32		hashkey;
+
+	Assert(keysize == sizeof(Notification *));
+	hashkey = DatumGetUInt32(hash_any_fast((const unsigned char *) n->channel,
+										   strlen(n->channel)));
+	hashkey = (hashkey << 1) | ((hashkey & 0x80000000) ? 1 : 0);
+	hashkey ^= DatumGetUInt32(hash_any_fast((const unsigned char *) n->payload,
+											strlen(n->payload)));
+	return hashkey;
+}
+
+/*
+ * notification_match: match function to use with notification_hash
+ */
+static int
+notification_match(const void *key1, const void *key2, Size keysize)
+{
+	const Notification *n1 = *(const Notification *const *) key1;
+	const Notification *n2 = *(const Notification *const *) key2;
+
+	Assert(keysize == sizeof(Notification *));
+	if (strcmp(n1->channel, n2->channel) == 0 &&
+		strcmp(n1->payload, n2->payload) == 0)
+		return 0;
+	return 1;
+}
+
 /* Clear the pendingActions and pendingNotifies lists. */
 static void
 ClearPendingActionsAndNotifies(void)
@@ -2088,5 +2409,5 @@ ClearPendingActionsAndNotifies(void)
 	 * pointers.
 	 */
 	pendingActions = NIL;
-	pendingNotifies = NIL;
+	pendingNotifies = NULL;
 }
@@ -22,6 +22,8 @@
 
 #include "access/heapam.h"
 #include "access/htup_details.h"
+#include "access/parallel.h"
+#include "access/printtup.h"
 #include "access/sysattr.h"
 #include "access/xact.h"
 #include "access/xlog.h"
@@ -31,16 +33,20 @@
 #include "commands/defrem.h"
 #include "commands/trigger.h"
 #include "executor/executor.h"
+#include "foreign/fdwapi.h"
 #include "libpq/libpq.h"
 #include "libpq/pqformat.h"
 #include "mb/pg_wchar.h"
 #include "miscadmin.h"
 #include "optimizer/clauses.h"
 #include "optimizer/planner.h"
+#include "port/simd.h"
 #include "parser/parse_relation.h"
 #include "nodes/makefuncs.h"
 #include "rewrite/rewriteHandler.h"
 #include "storage/fd.h"
+#include "storage/shm_mq.h"
+#include "storage/spin.h"
 #include "tcop/tcopprot.h"
 #include "utils/acl.h"
 #include "utils/builtins.h"
@@ -63,7 +69,8 @@ typedef enum CopyDest
 {
 	COPY_FILE,					/* to/from file (or a piped program) */
 	COPY_OLD_FE,				/* to/from frontend (2.0 protocol) */
-	COPY_NEW_FE					/* to/from frontend (3.0 protocol) */
+	COPY_NEW_FE,				/* to/from frontend (3.0 protocol) */
+	COPY_CALLBACK				/* from callback function */
 } CopyDest;
 
 /*
@@ -98,6 +105,7 @@ typedef struct CopyStateData
 	/* low-level state data */
 	CopyDest	copy_dest;		/* type of copy source/destination */
 	FILE	   *copy_file;		/* used if copy_dest == COPY_FILE */
+	copy_data_source_cb data_source_cb; /* used if copy_dest == COPY_CALLBACK */
 	StringInfo	fe_msgbuf;		/* used for all dests during COPY TO, only for
 								 * dest == COPY_NEW_FE in COPY FROM */
 	bool		fe_eof;			/* true if detected end of copy data */
@@ -133,6 +141,9 @@ typedef struct CopyStateData
 	bool		convert_selectively;	/* do selective binary conversion? */
 	List	   *convert_select; /* list of column names (can be NIL) */
 	bool	   *convert_select_flags;	/* per-column CSV/TEXT CS flags */
+	int			parallel_workers;	/* number of workers for COPY FROM */
+	List	   *attnamelist;	/* column names, to pass on to workers */
+	List	   *options;		/* options, to pass on to workers */
 
 	/* these are just for error messages, see CopyFromErrorCallback */
 	const char *cur_relname;	/* table name for error messages */
@@ -149,6 +160,7 @@ typedef struct CopyStateData
 	 * Working state for COPY TO
 	 */
 	FmgrInfo   *out_functions;	/* lookup info for output functions */
+	DirectSendFunc *direct_send;	/* direct binary output fns, or NULLs */
 	MemoryContext rowcontext;	/* per-row evaluation context */
 
 	/*
@@ -165,6 +177,19 @@ typedef struct CopyStateData
 	bool		volatile_defexprs;		/* is any of defexprs volatile? */
 	List	   *range_table;
 
+	/*
+	 * In a parallel COPY FROM worker, the lines come from the leader through
+	 * chunk_queue rather than from the data source, see
+	 * CopyReadLineFromQueue.  parallel_hi_options are the heap_insert options
+	 * the leader chose.
+	 */
+	shm_mq_handle *chunk_queue;
+	char	   *chunk_data;		/* current chunk */
+	Size		chunk_len;		/* length of current chunk */
+	Size		chunk_pos;		/* next byte to process in the chunk */
+	bool		chunk_eof;		/* leader has sent everything? */
+	int			parallel_hi_options;
+
 	/*
 	 * These variables are used to reduce overhead in textual COPY FROM.
 	 *
@@ -212,6 +237,59 @@ typedef struct
 	uint64		processed;		/* # of tuples processed */
 } DR_copy;
 
+/*
+ * Parallel COPY FROM
+ *
+ * The leader reads the data source and splits it into lines, converting
+ * them to the server encoding, just as a serial COPY would.  It hands the
+ * lines out in chunks, round-robin, through a shm_mq per worker.  The workers
+ * do the rest: splitting the lines into fields, running the input functions
+ * and default expressions, checking constraints and inserting into the heap
+ * and the indexes.
+ *
+ * A chunk is a series of lines, each a ParallelCopyLineHeader followed by
+ * the line itself.  The line number travels with the line, since a quoted
+ * CSV field can span several physical lines.  A zero-length message tells
+ * the worker there are no more chunks.
+ */
+#define PARALLEL_KEY_COPY_SHARED		UINT64CONST(0xC000000000000001)
+#define PARALLEL_KEY_COPY_OPTIONS		UINT64CONST(0xC000000000000002)
+#define PARALLEL_KEY_COPY_QUEUES		UINT64CONST(0xC000000000000003)
+
+#define PARALLEL_COPY_CHUNK_SIZE		65536
+#define PARALLEL_COPY_QUEUE_SIZE		(4 * PARALLEL_COPY_CHUNK_SIZE)
+
+/* State shared by the leader and the workers */
+typedef struct ParallelCopyShared
+{
+	Oid			relid;			/* table being loaded */
+	int			hi_options;		/* heap_insert options chosen by leader */
+	slock_t		mutex;			/* protects processed */
+	uint64		processed;		/* # of tuples inserted by the workers */
+} ParallelCopyShared;
+
+typedef struct ParallelCopyLineHeader
+{
+	int			lineno;			/* line number, for error messages */
+	int32		len;			/* length of the line that follows */
+} ParallelCopyLineHeader;
+
+/* Leader's private state */
+typedef struct ParallelCopyLeader
+{
+	ParallelContext *pcxt;
+	ParallelCopyShared *shared;
+	int			nqueues;		/* one per launched worker */
+	shm_mq_handle **queues;
+	int			next_queue;		/* who gets the next chunk */
+	StringInfoData chunk;		/* chunk being filled, or empty */
+} ParallelCopyLeader;
+
+/* Has a parallel COPY worker used up the chunk it got last? */
+#define CopyChunkExhausted(cstate) \
+	((cstate)->chunk_queue != NULL && \
+	 (cstate)->chunk_pos >= (cstate)->chunk_len)
+
 
 /*
  * These macros centralize code used to process line_buf and raw_buf buffers.
@@ -295,13 +373,26 @@ static uint64 DoCopyTo(CopyState cstate);
 static uint64 CopyTo(CopyState cstate);
 static void CopyOneRowTo(CopyState cstate, Oid tupleOid,
 			 Datum *values, bool *nulls);
-static uint64 CopyFrom(CopyState cstate);
-static void CopyFromInsertBatch(CopyState cstate, EState *estate,
+static int CopyFromInsertBatch(CopyState cstate, EState *estate,
 					CommandId mycid, int hi_options,
 					ResultRelInfo *resultRelInfo, TupleTableSlot *myslot,
 					BulkInsertState bistate,
 					int nBufferedTuples, HeapTuple *bufferedTuples,
+					TupleTableSlot **bufferedSlots,
 					int firstBufferedLineNo);
+static CopyState BeginCopyFromSource(Relation rel, const char *filename,
+					bool is_program, List *attnamelist, List *options,
+					shm_mq_handle *chunk_queue,
+					copy_data_source_cb data_source_cb);
+static int ParallelCopyWorkers(CopyState cstate,
+					ResultRelInfo *resultRelInfo);
+static ParallelCopyLeader *BeginParallelCopy(CopyState cstate, int nworkers,
+				  int hi_options);
+static bool ParallelCopySendLine(CopyState cstate, ParallelCopyLeader *pcopy);
+static void ParallelCopySendChunk(ParallelCopyLeader *pcopy);
+static uint64 EndParallelCopy(ParallelCopyLeader *pcopy);
+static void ParallelCopyMain(dsm_segment *seg, shm_toc *toc);
+static bool CopyReadLineFromQueue(CopyState cstate);
 static bool CopyReadLine(CopyState cstate);
 static bool CopyReadLineText(CopyState cstate);
 static int	CopyReadAttributesText(CopyState cstate);
@@ -549,6 +640,9 @@ CopySendEndOfRow(CopyState cstate)
 			/* Dump the accumulated row as one CopyData message */
 			(void) pq_putmessage('d', fe_msgbuf->data, fe_msgbuf->len);
 			break;
+		case COPY_CALLBACK:
+			Assert(false);		/* Not yet supported. */
+			break;
 	}
 
 	resetStringInfo(fe_msgbuf);
@@ -663,6 +757,9 @@ CopyGetData(CopyState cstate, void *databuf, int minread, int maxread)
 				bytesread += avail;
 			}
 			break;
+		case COPY_CALLBACK:
+			bytesread = cstate->data_source_cb(databuf, minread, maxread);
+			break;
 	}
 
 	return bytesread;
@@ -1144,6 +1241,19 @@ ProcessCopyOptions(CopyState cstate,
 						 errmsg("argument to option \"%s\" must be a valid encoding name",
 								defel->defname)));
 		}
+		else if (strcmp(defel->defname, "parallel") == 0)
+		{
+			if (cstate->parallel_workers > 0)
+				ereport(ERROR,
+						(errcode(ERRCODE_SYNTAX_ERROR),
+						 errmsg("conflicting or redundant options")));
+			cstate->parallel_workers = defGetInt32(defel);
+			if (cstate->parallel_workers <= 0)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("argument to option \"%s\" must be a positive integer",
+								defel->defname)));
+		}
 		else
 			ereport(ERROR,
 					(errcode(ERRCODE_SYNTAX_ERROR),
@@ -1281,6 +1391,12 @@ ProcessCopyOptions(CopyState cstate,
 				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
 				 errmsg("COPY force null only available using COPY FROM")));
 
+	/* Check parallel */
+	if (cstate->parallel_workers > 0 && !is_from)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("COPY parallel only available using COPY FROM")));
+
 	/* Don't allow the delimiter to appear in the null string. */
 	if (strchr(cstate->null_print, cstate->delim[0]) != NULL)
 		ereport(ERROR,
@@ -1815,6 +1931,8 @@ CopyTo(CopyState cstate)
 
 	/* Get info about the columns we need to process. */
 	cstate->out_functions = (FmgrInfo *) palloc(num_phys_attrs * sizeof(FmgrInfo));
+	cstate->direct_send = (DirectSendFunc *)
+		palloc0(num_phys_attrs * sizeof(DirectSendFunc));
 	foreach(cur, cstate->attnumlist)
 	{
 		int			attnum = lfirst_int(cur);
@@ -1830,6 +1948,8 @@ CopyTo(CopyState cstate)
 							  &out_func_oid,
 							  &isvarlena);
 		fmgr_info(out_func_oid, &cstate->out_functions[attnum - 1]);
+		if (cstate->binary)
+			cstate->direct_send[attnum - 1] = GetDirectSendFunc(out_func_oid);
 	}
 
 	/*
@@ -2018,6 +2138,8 @@ CopyOneRowTo(CopyState cstate, Oid tupleOid, Datum *values, bool *nulls)
 				else
 					CopyAttributeOutText(cstate, string);
 			}
+			else if (cstate->direct_send[attnum - 1])
+				cstate->direct_send[attnum - 1] (cstate->fe_msgbuf, value);
 			else
 			{
 				bytea	   *outputbytes;
@@ -2147,7 +2269,7 @@ limit_printout_length(const char *str)
 /*
  * Copy FROM file to relation.
  */
-static uint64
+uint64
 CopyFrom(CopyState cstate)
 {
 	HeapTuple	tuple;
@@ -2161,15 +2283,18 @@ CopyFrom(CopyState cstate)
 	MemoryContext oldcontext = CurrentMemoryContext;
 
 	ErrorContextCallback errcallback;
-	CommandId	mycid = GetCurrentCommandId(true);
+	CommandId	mycid = GetCurrentCommandId(!IsParallelWorker());
 	int			hi_options = 0; /* start with default heap_insert options */
 	BulkInsertState bistate;
 	uint64		processed = 0;
 	bool		useHeapMultiInsert;
+	int			nworkers;
+	ParallelCopyLeader *pcopy = NULL;
 	int			nBufferedTuples = 0;
 
 #define MAX_BUFFERED_TUPLES 1000
 	HeapTuple  *bufferedTuples = NULL;	/* initialize to silence warning */
+	TupleTableSlot **bufferedSlots = NULL;	/* for a foreign table */
 	Size		bufferedTuplesSize = 0;
 	int			firstBufferedLineNo = 0;
 
@@ -2188,10 +2313,24 @@ CopyFrom(CopyState cstate)
 					 errmsg("cannot copy to materialized view \"%s\"",
 							RelationGetRelationName(cstate->rel))));
 		else if (cstate->rel->rd_rel->relkind == RELKIND_FOREIGN_TABLE)
-			ereport(ERROR,
-					(errcode(ERRCODE_WRONG_OBJECT_TYPE),
-					 errmsg("cannot copy to foreign table \"%s\"",
-							RelationGetRelationName(cstate->rel))));
+		{
+			/* Okay only if the FDW supports it */
+			FdwRoutine *fdwroutine = GetFdwRoutineForRelation(cstate->rel,
+															  false);
+
+			if (fdwroutine->BeginForeignInsert == NULL ||
+				fdwroutine->ExecForeignInsert == NULL)
+				ereport(ERROR,
+						(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+						 errmsg("cannot copy to foreign table \"%s\"",
+								RelationGetRelationName(cstate->rel))));
+			if (fdwroutine->IsForeignRelUpdatable != NULL &&
+				(fdwroutine->IsForeignRelUpdatable(cstate->rel) & (1 << CMD_INSERT)) == 0)
+				ereport(ERROR,
+						(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+						 errmsg("foreign table \"%s\" does not allow inserts",
+								RelationGetRelationName(cstate->rel))));
+		}
 		else if (cstate->rel->rd_rel->relkind == RELKIND_SEQUENCE)
 			ereport(ERROR,
 					(errcode(ERRCODE_WRONG_OBJECT_TYPE),
@@ -2273,6 +2412,31 @@ CopyFrom(CopyState cstate)
 
 		hi_options |= HEAP_INSERT_FROZEN;
 	}
+	else if (cstate->rel->rd_createSubid == GetCurrentSubTransactionId() &&
+			 cstate->rel->trigdesc == NULL &&
+			 ThereAreNoPriorRegisteredSnapshots() && ThereAreNoReadyPortals())
+	{
+		/*
+		 * Likewise if the table was created, not merely truncated, in this
+		 * subxact.  No other transaction can see a table that isn't committed
+		 * yet, so unlike FREEZE after a TRUNCATE, this cannot make rows
+		 * visible to anyone who shouldn't see them, and we can do it without
+		 * being asked.  (We don't if there are triggers, though, since those
+		 * could look at the table and see rows loaded after the current
+		 * one.)  This spares the first reader of the table from setting hint
+		 * bits on, and so rewriting, every page we load, and VACUUM from
+		 * having to freeze them all again later.
+		 */
+		hi_options |= HEAP_INSERT_FROZEN;
+	}
+
+	/* None of that is any use for a foreign table */
+	if (cstate->rel->rd_rel->relkind == RELKIND_FOREIGN_TABLE)
+		hi_options = 0;
+
+	/* A parallel worker does as its leader decided */
+	if (IsParallelWorker())
+		hi_options = cstate->parallel_hi_options;
 
 	/*
 	 * We need a ResultRelInfo so we can use the regular executor's
@@ -2290,7 +2454,7 @@ CopyFrom(CopyState cstate)
 	estate->es_result_relations = resultRelInfo;
 	estate->es_num_result_relations = 1;
 	estate->es_result_relation_info = resultRelInfo;
-	estate->es_range_table = cstate->range_table;
+	ExecInitRangeTable(estate, cstate->range_table);
 
 	/* Set up a tuple slot too */
 	myslot = ExecInitExtraTupleSlot(estate);
@@ -2306,6 +2470,10 @@ CopyFrom(CopyState cstate)
 	 * expressions. Such triggers or expressions might query the table we're
 	 * inserting to, and act differently if the tuples that have already been
 	 * processed and prepared for insertion are not there.
+	 *
+	 * A foreign table gets its tuples in batches too, if the FDW can take
+	 * them that way.  Not if it has AFTER ROW triggers, though: those need
+	 * each tuple as the FDW reports it inserted.
 	 */
 	if ((resultRelInfo->ri_TrigDesc != NULL &&
 		 (resultRelInfo->ri_TrigDesc->trig_insert_before_row ||
@@ -2314,10 +2482,20 @@ CopyFrom(CopyState cstate)
 	{
 		useHeapMultiInsert = false;
 	}
+	else if (resultRelInfo->ri_FdwRoutine != NULL &&
+			 (resultRelInfo->ri_FdwRoutine->ExecForeignBatchInsert == NULL ||
+			  (resultRelInfo->ri_TrigDesc != NULL &&
+			   resultRelInfo->ri_TrigDesc->trig_insert_after_row)))
+	{
+		useHeapMultiInsert = false;
+	}
 	else
 	{
 		useHeapMultiInsert = true;
 		bufferedTuples = palloc(MAX_BUFFERED_TUPLES * sizeof(HeapTuple));
+		if (resultRelInfo->ri_FdwRoutine != NULL)
+			bufferedSlots = palloc0(MAX_BUFFERED_TUPLES *
+									sizeof(TupleTableSlot *));
 	}
 
 	/* Prepare to catch AFTER triggers. */
@@ -2327,9 +2505,21 @@ CopyFrom(CopyState cstate)
 	 * Check BEFORE STATEMENT insertion triggers. It's debatable whether we
 	 * should do this for COPY, since it's not really an "INSERT" statement as
 	 * such. However, executing these triggers maintains consistency with the
-	 * EACH ROW triggers that we already fire on COPY.
+	 * EACH ROW triggers that we already fire on COPY.  In a parallel COPY,
+	 * statement triggers are the leader's business.
 	 */
-	ExecBSInsertTriggers(estate, resultRelInfo);
+	if (!IsParallelWorker())
+		ExecBSInsertTriggers(estate, resultRelInfo);
+
+	/* Farm the work out to parallel workers, if asked to and it's safe */
+	nworkers = ParallelCopyWorkers(cstate, resultRelInfo);
+	if (nworkers > 0)
+		pcopy = BeginParallelCopy(cstate, nworkers, hi_options);
+
+	/* Let the FDW get ready to insert into a foreign table */
+	if (resultRelInfo->ri_FdwRoutine != NULL)
+		resultRelInfo->ri_FdwRoutine->BeginForeignInsert(estate,
+														 resultRelInfo);
 
 	values = (Datum *) palloc(tupDesc->natts * sizeof(Datum));
 	nulls = (bool *) palloc(tupDesc->natts * sizeof(bool));
@@ -2351,6 +2541,14 @@ CopyFrom(CopyState cstate)
 
 		CHECK_FOR_INTERRUPTS();
 
+		/* In a parallel COPY, the leader only hands out the lines */
+		if (pcopy != NULL)
+		{
+			if (!ParallelCopySendLine(cstate, pcopy))
+				break;
+			continue;
+		}
+
 		if (nBufferedTuples == 0)
 		{
 			/*
@@ -2402,8 +2600,12 @@ CopyFrom(CopyState cstate)
 
 		if (!skip_tuple)
 		{
-			/* Check the constraints of the tuple */
-			if (cstate->rel->rd_att->constr)
+			/*
+			 * Check the constraints of the tuple.  As in INSERT, a foreign
+			 * table's constraints are for the remote end to enforce.
+			 */
+			if (cstate->rel->rd_att->constr &&
+				resultRelInfo->ri_FdwRoutine == NULL)
 				ExecConstraints(resultRelInfo, slot, estate);
 
 			if (useHeapMultiInsert)
@@ -2418,15 +2620,23 @@ CopyFrom(CopyState cstate)
 				 * If the buffer filled up, flush it. Also flush if the total
 				 * size of all the tuples in the buffer becomes large, to
 				 * avoid using large amounts of memory for the buffers when
-				 * the tuples are exceptionally wide.
+				 * the tuples are exceptionally wide.  A parallel worker
+				 * flushes at the end of each chunk it gets, because the
+				 * next chunk's lines don't follow on from these, and
+				 * CopyFromInsertBatch counts on that for error messages.
 				 */
 				if (nBufferedTuples == MAX_BUFFERED_TUPLES ||
-					bufferedTuplesSize > 65535)
+					bufferedTuplesSize > 65535 ||
+					CopyChunkExhausted(cstate))
 				{
-					CopyFromInsertBatch(cstate, estate, mycid, hi_options,
-										resultRelInfo, myslot, bistate,
-										nBufferedTuples, bufferedTuples,
-										firstBufferedLineNo);
+					processed += CopyFromInsertBatch(cstate, estate, mycid,
+													 hi_options,
+													 resultRelInfo, myslot,
+													 bistate,
+													 nBufferedTuples,
+													 bufferedTuples,
+													 bufferedSlots,
+													 firstBufferedLineNo);
 					nBufferedTuples = 0;
 					bufferedTuplesSize = 0;
 				}
@@ -2435,36 +2645,62 @@ CopyFrom(CopyState cstate)
 			{
 				List	   *recheckIndexes = NIL;
 
-				/* OK, store the tuple and create index entries for it */
-				heap_insert(cstate->rel, tuple, mycid, hi_options, bistate);
-
-				if (resultRelInfo->ri_NumIndices > 0)
-					recheckIndexes = ExecInsertIndexTuples(slot, &(tuple->t_self),
-														 estate, false, NULL,
-														   NIL);
+				if (resultRelInfo->ri_FdwRoutine != NULL)
+				{
+					/* Let the FDW insert it; it may change it, or skip it */
+					slot = resultRelInfo->ri_FdwRoutine->ExecForeignInsert(estate,
+															   resultRelInfo,
+																	   slot,
+																	   NULL);
+					if (slot == NULL)
+						continue;
+					tuple = ExecMaterializeSlot(slot);
+				}
+				else
+				{
+					/* OK, store the tuple and create index entries for it */
+					heap_insert(cstate->rel, tuple, mycid, hi_options,
+								bistate);
+
+					if (resultRelInfo->ri_NumIndices > 0)
+						recheckIndexes = ExecInsertIndexTuples(slot,
+															&(tuple->t_self),
+															   estate, false,
+															   NULL, NIL);
+				}
 
 				/* AFTER ROW INSERT Triggers */
 				ExecARInsertTriggers(estate, resultRelInfo, tuple,
 									 recheckIndexes);
 
 				list_free(recheckIndexes);
-			}
 
-			/*
-			 * We count only tuples not suppressed by a BEFORE INSERT trigger;
-			 * this is the same definition used by execMain.c for counting
-			 * tuples inserted by an INSERT command.
-			 */
-			processed++;
+				/*
+				 * We count only tuples not suppressed by a BEFORE INSERT
+				 * trigger; this is the same definition used by execMain.c for
+				 * counting tuples inserted by an INSERT command.  Buffered
+				 * tuples are counted when they're flushed.
+				 */
+				processed++;
+			}
 		}
 	}
 
+	/* Wait for the workers to load the rest */
+	if (pcopy != NULL)
+		processed = EndParallelCopy(pcopy);
+
 	/* Flush any remaining buffered tuples */
 	if (nBufferedTuples > 0)
-		CopyFromInsertBatch(cstate, estate, mycid, hi_options,
-							resultRelInfo, myslot, bistate,
-							nBufferedTuples, bufferedTuples,
-							firstBufferedLineNo);
+		processed += CopyFromInsertBatch(cstate, estate, mycid, hi_options,
+										 resultRelInfo, myslot, bistate,
+										 nBufferedTuples, bufferedTuples,
+										 bufferedSlots,
+										 firstBufferedLineNo);
+
+	if (resultRelInfo->ri_FdwRoutine != NULL &&
+		resultRelInfo->ri_FdwRoutine->EndForeignInsert != NULL)
+		resultRelInfo->ri_FdwRoutine->EndForeignInsert(estate, resultRelInfo);
 
 	/* Done, clean up */
 	error_context_stack = errcallback.previous;
@@ -2481,7 +2717,8 @@ CopyFrom(CopyState cstate)
 		pq_endmsgread();
 
 	/* Execute AFTER STATEMENT insertion triggers */
-	ExecASInsertTriggers(estate, resultRelInfo);
+	if (!IsParallelWorker())
+		ExecASInsertTriggers(estate, resultRelInfo);
 
 	/* Handle queued AFTER triggers */
 	AfterTriggerEndQuery(estate);
@@ -2497,9 +2734,10 @@ CopyFrom(CopyState cstate)
 
 	/*
 	 * If we skipped writing WAL, then we need to sync the heap (but not
-	 * indexes since those use WAL anyway)
+	 * indexes since those use WAL anyway).  The leader of a parallel COPY
+	 * does that for its workers too.
 	 */
-	if (hi_options & HEAP_INSERT_SKIP_WAL)
+	if ((hi_options & HEAP_INSERT_SKIP_WAL) && !IsParallelWorker())
 		heap_sync(cstate->rel);
 
 	return processed;
@@ -2509,12 +2747,19 @@ CopyFrom(CopyState cstate)
  * A subroutine of CopyFrom, to write the current batch of buffered heap
  * tuples to the heap. Also updates indexes and runs AFTER ROW INSERT
  * triggers.
+ *
+ * For a foreign table, the batch goes to the FDW instead, through
+ * bufferedSlots, an array of slots of the same size as bufferedTuples,
+ * filled in as needed.
+ *
+ * Returns the number of tuples inserted.
  */
-static void
+static int
 CopyFromInsertBatch(CopyState cstate, EState *estate, CommandId mycid,
 					int hi_options, ResultRelInfo *resultRelInfo,
 					TupleTableSlot *myslot, BulkInsertState bistate,
 					int nBufferedTuples, HeapTuple *bufferedTuples,
+					TupleTableSlot **bufferedSlots,
 					int firstBufferedLineNo)
 {
 	MemoryContext oldcontext;
@@ -2528,6 +2773,35 @@ CopyFromInsertBatch(CopyState cstate, EState *estate, CommandId mycid,
 	cstate->line_buf_valid = false;
 	save_cur_lineno = cstate->cur_lineno;
 
+	if (resultRelInfo->ri_FdwRoutine != NULL)
+	{
+		int			ninserted;
+
+		for (i = 0; i < nBufferedTuples; i++)
+		{
+			if (bufferedSlots[i] == NULL)
+			{
+				bufferedSlots[i] = ExecInitExtraTupleSlot(estate);
+				ExecSetSlotDescriptor(bufferedSlots[i],
+									  RelationGetDescr(cstate->rel));
+			}
+			ExecStoreTuple(bufferedTuples[i], bufferedSlots[i],
+						   InvalidBuffer, false);
+		}
+
+		/* No AFTER ROW triggers to run, see CopyFrom */
+		ninserted = resultRelInfo->ri_FdwRoutine->ExecForeignBatchInsert(estate,
+															   resultRelInfo,
+															   bufferedSlots,
+															nBufferedTuples);
+
+		for (i = 0; i < nBufferedTuples; i++)
+			ExecClearTuple(bufferedSlots[i]);
+
+		cstate->cur_lineno = save_cur_lineno;
+		return ninserted;
+	}
+
 	/*
 	 * heap_multi_insert leaks memory, so switch to short-lived memory context
 	 * before calling it.
@@ -2568,7 +2842,8 @@ CopyFromInsertBatch(CopyState cstate, EState *estate, CommandId mycid,
 	 * anyway.
 	 */
 	else if (resultRelInfo->ri_TrigDesc != NULL &&
-			 resultRelInfo->ri_TrigDesc->trig_insert_after_row)
+			 (resultRelInfo->ri_TrigDesc->trig_insert_after_row ||
+			  resultRelInfo->ri_TrigDesc->trig_insert_new_table))
 	{
 		for (i = 0; i < nBufferedTuples; i++)
 		{
@@ -2581,6 +2856,8 @@ CopyFromInsertBatch(CopyState cstate, EState *estate, CommandId mycid,
 
 	/* reset cur_lineno to where we were */
 	cstate->cur_lineno = save_cur_lineno;
+
+	return nBufferedTuples;
 }
 
 /*
@@ -2599,6 +2876,80 @@ BeginCopyFrom(Relation rel,
 			  bool is_program,
 			  List *attnamelist,
 			  List *options)
+{
+	return BeginCopyFromSource(rel, filename, is_program, attnamelist,
+							   options, NULL, NULL);
+}
+
+/*
+ * Setup to read tuples for COPY FROM from a caller-supplied function.
+ *
+ * 'data_source_cb' is called like CopyGetData: it must return at least
+ * minread and at most maxread bytes, fewer than minread only at the end
+ * of the data.  The caller is then expected to run CopyFrom() to do the
+ * actual load; this sets up the same range table DoCopy would, so that
+ * constraint checking works and the caller's INSERT privilege is checked.
+ */
+CopyState
+BeginCopyFromCallback(Relation rel,
+					  copy_data_source_cb data_source_cb,
+					  List *attnamelist,
+					  List *options)
+{
+	CopyState	cstate;
+	RangeTblEntry *rte;
+	ListCell   *cur;
+
+	cstate = BeginCopyFromSource(rel, NULL, false, attnamelist, options,
+								 NULL, data_source_cb);
+
+	rte = makeNode(RangeTblEntry);
+	rte->rtekind = RTE_RELATION;
+	rte->relid = RelationGetRelid(rel);
+	rte->relkind = rel->rd_rel->relkind;
+	rte->requiredPerms = ACL_INSERT;
+	foreach(cur, cstate->attnumlist)
+	{
+		int			attno = lfirst_int(cur) -
+		FirstLowInvalidHeapAttributeNumber;
+
+		rte->insertedCols = bms_add_member(rte->insertedCols, attno);
+	}
+	cstate->range_table = list_make1(rte);
+	ExecCheckRTPerms(cstate->range_table, true);
+
+	return cstate;
+}
+
+/*
+ * Setup to read tuples with NextCopyFrom from a caller-supplied function,
+ * like BeginCopyFromCallback, for a caller that merely reads the file rather
+ * than loading it into 'rel', such as file_fdw.  No range table is set up
+ * and no privileges are checked here; that is up to the caller.
+ */
+CopyState
+BeginCopyFromReader(Relation rel,
+					copy_data_source_cb data_source_cb,
+					List *attnamelist,
+					List *options)
+{
+	return BeginCopyFromSource(rel, NULL, false, attnamelist, options,
+							   NULL, data_source_cb);
+}
+
+/*
+ * Workhorse for BeginCopyFrom.  In a parallel COPY worker, 'chunk_queue' is
+ * the queue the leader sends the input lines through, and 'filename' is NULL.
+ * Likewise 'data_source_cb', if given, supplies the data instead of a file.
+ */
+static CopyState
+BeginCopyFromSource(Relation rel,
+					const char *filename,
+					bool is_program,
+					List *attnamelist,
+					List *options,
+					shm_mq_handle *chunk_queue,
+					copy_data_source_cb data_source_cb)
 {
 	CopyState	cstate;
 	bool		pipe = (filename == NULL);
@@ -2625,6 +2976,8 @@ BeginCopyFrom(Relation rel,
 	cstate->cur_lineno = 0;
 	cstate->cur_attname = NULL;
 	cstate->cur_attval = NULL;
+	cstate->attnamelist = attnamelist;
+	cstate->options = options;
 
 	/* Set up variables to avoid per-attribute overhead. */
 	initStringInfo(&cstate->attribute_buf);
@@ -2711,7 +3064,18 @@ BeginCopyFrom(Relation rel,
 	cstate->num_defaults = num_defaults;
 	cstate->is_program = is_program;
 
-	if (pipe)
+	if (chunk_queue != NULL)
+	{
+		/* the leader reads the data source for us */
+		Assert(!cstate->binary);
+		cstate->chunk_queue = chunk_queue;
+	}
+	else if (data_source_cb != NULL)
+	{
+		cstate->copy_dest = COPY_CALLBACK;
+		cstate->data_source_cb = data_source_cb;
+	}
+	else if (pipe)
 	{
 		Assert(!is_program);	/* the grammar does not allow this */
 		if (whereToSendOutput == DestRemote)
@@ -2849,7 +3213,10 @@ NextCopyFromRawFields(CopyState cstate, char ***fields, int *nfields)
 	cstate->cur_lineno++;
 
 	/* Actually read the line into memory here */
-	done = CopyReadLine(cstate);
+	if (cstate->chunk_queue != NULL)
+		done = CopyReadLineFromQueue(cstate);
+	else
+		done = CopyReadLine(cstate);
 
 	/*
 	 * EOF at start of line means we're done.  If we see EOF after some
@@ -3130,6 +3497,388 @@ EndCopyFrom(CopyState cstate)
 	EndCopy(cstate);
 }
 
+/*
+ * Decide how many workers to use for a COPY FROM, or 0 if it shouldn't be
+ * done in parallel.
+ *
+ * Anything a worker can't do the same way the leader would means a serial
+ * COPY.  Row triggers see the rows in input order, and AFTER ROW triggers
+ * (foreign key checks included) are queued in the backend that inserted the
+ * row.  Volatile defaults might look at the rows loaded so far.  Deferred
+ * uniqueness and exclusion checks are queued like triggers.  Expressions
+ * that aren't parallel safe can't run in a worker at all.
+ */
+static int
+ParallelCopyWorkers(CopyState cstate, ResultRelInfo *resultRelInfo)
+{
+	TriggerDesc *trigdesc = resultRelInfo->ri_TrigDesc;
+	TupleConstr *constr = RelationGetDescr(cstate->rel)->constr;
+	int			i;
+
+	if (cstate->parallel_workers <= 0 || IsParallelWorker())
+		return 0;
+
+	/* There's no way to find the tuple boundaries without parsing them */
+	if (cstate->binary)
+		return 0;
+
+	/* Workers can't see our temp buffers, or share our predicate locks */
+	if (RelationUsesLocalBuffers(cstate->rel) || IsolationIsSerializable())
+		return 0;
+
+	/* Nor our foreign table connections */
+	if (cstate->rel->rd_rel->relkind != RELKIND_RELATION)
+		return 0;
+
+	if (trigdesc != NULL &&
+		(trigdesc->trig_insert_before_row ||
+		 trigdesc->trig_insert_after_row ||
+		 trigdesc->trig_insert_new_table ||
+		 trigdesc->trig_insert_instead_row))
+		return 0;
+
+	if (cstate->volatile_defexprs)
+		return 0;
+	for (i = 0; i < cstate->num_defaults; i++)
+	{
+		if (has_parallel_hazard((Node *) cstate->defexprs[i]->expr, false))
+			return 0;
+	}
+
+	if (constr != NULL)
+	{
+		for (i = 0; i < constr->num_check; i++)
+		{
+			if (has_parallel_hazard(stringToNode(constr->check[i].ccbin),
+									false))
+				return 0;
+		}
+	}
+
+	for (i = 0; i < resultRelInfo->ri_NumIndices; i++)
+	{
+		Relation	indexRel = resultRelInfo->ri_IndexRelationDescs[i];
+		IndexInfo  *ii = resultRelInfo->ri_IndexRelationInfo[i];
+
+		if (ii->ii_ExclusionOps != NULL || !indexRel->rd_index->indimmediate)
+			return 0;
+		if (has_parallel_hazard((Node *) ii->ii_Expressions, false) ||
+			has_parallel_hazard((Node *) ii->ii_Predicate, false))
+			return 0;
+	}
+
+	return Min(cstate->parallel_workers, max_worker_processes);
+}
+
+/*
+ * Enter parallel mode and launch workers to load the data.
+ *
+ * Returns NULL, having left parallel mode again, if no worker could be
+ * started; the caller then does the whole job itself.
+ */
+static ParallelCopyLeader *
+BeginParallelCopy(CopyState cstate, int nworkers, int hi_options)
+{
+	ParallelCopyLeader *pcopy;
+	ParallelContext *pcxt;
+	ParallelCopyShared *shared;
+	char	   *options;
+	char	   *optionsspace;
+	char	   *queuespace;
+	int			i;
+
+	/*
+	 * The workers insert under our transaction ID, so it had better exist
+	 * before they start.  The workers re-read the column list and options
+	 * rather than being sent our CopyState.
+	 */
+	(void) GetCurrentTransactionId();
+	options = nodeToString(list_make2(cstate->attnamelist, cstate->options));
+
+	EnterParallelMode();
+	pcxt = CreateParallelContext(ParallelCopyMain, nworkers);
+
+	/* Estimate space for the shared state, options and chunk queues */
+	shm_toc_estimate_chunk(&pcxt->estimator, sizeof(ParallelCopyShared));
+	shm_toc_estimate_chunk(&pcxt->estimator, strlen(options) + 1);
+	shm_toc_estimate_chunk(&pcxt->estimator,
+						   PARALLEL_COPY_QUEUE_SIZE * pcxt->nworkers);
+	shm_toc_estimate_keys(&pcxt->estimator, 3);
+
+	InitializeParallelDSM(pcxt);
+
+	shared = (ParallelCopyShared *)
+		shm_toc_allocate(pcxt->toc, sizeof(ParallelCopyShared));
+	shared->relid = RelationGetRelid(cstate->rel);
+	shared->hi_options = hi_options;
+	SpinLockInit(&shared->mutex);
+	shared->processed = 0;
+	shm_toc_insert(pcxt->toc, PARALLEL_KEY_COPY_SHARED, shared);
+
+	optionsspace = shm_toc_allocate(pcxt->toc, strlen(options) + 1);
+	strcpy(optionsspace, options);
+	shm_toc_insert(pcxt->toc, PARALLEL_KEY_COPY_OPTIONS, optionsspace);
+
+	/* Set up a chunk queue for each worker, with the leader sending */
+	queuespace = shm_toc_allocate(pcxt->toc,
+								  PARALLEL_COPY_QUEUE_SIZE * pcxt->nworkers);
+	for (i = 0; i < pcxt->nworkers; i++)
+	{
+		shm_mq	   *mq;
+
+		mq = shm_mq_create(queuespace + i * PARALLEL_COPY_QUEUE_SIZE,
+						   (Size) PARALLEL_COPY_QUEUE_SIZE);
+		shm_mq_set_sender(mq, MyProc);
+	}
+	shm_toc_insert(pcxt->toc, PARALLEL_KEY_COPY_QUEUES, queuespace);
+
+	LaunchParallelWorkers(pcxt);
+
+	if (pcxt->nworkers_launched == 0)
+	{
+		DestroyParallelContext(pcxt);
+		ExitParallelMode();
+		return NULL;
+	}
+
+	/* Attach to the queues of the workers that actually started */
+	pcopy = (ParallelCopyLeader *) palloc0(sizeof(ParallelCopyLeader));
+	pcopy->pcxt = pcxt;
+	pcopy->shared = shared;
+	pcopy->nqueues = pcxt->nworkers_launched;
+	pcopy->queues = (shm_mq_handle **)
+		palloc(pcxt->nworkers_launched * sizeof(shm_mq_handle *));
+	for (i = 0; i < pcxt->nworkers_launched; i++)
+	{
+		shm_mq	   *mq = (shm_mq *) (queuespace + i * PARALLEL_COPY_QUEUE_SIZE);
+
+		pcopy->queues[i] = shm_mq_attach(mq, pcxt->seg, NULL);
+		shm_mq_set_handle(pcopy->queues[i], pcxt->worker[i].bgwhandle);
+	}
+	initStringInfo(&pcopy->chunk);
+
+	return pcopy;
+}
+
+/*
+ * Read the next input line and add it to the chunk being filled, sending the
+ * chunk off if it's full.  This is the leader's replacement for
+ * NextCopyFrom.  Returns false if there are no more lines.
+ */
+static bool
+ParallelCopySendLine(CopyState cstate, ParallelCopyLeader *pcopy)
+{
+	bool		done;
+	ParallelCopyLineHeader header;
+
+	/* on input just throw the header line away */
+	if (cstate->cur_lineno == 0 && cstate->header_line)
+	{
+		cstate->cur_lineno++;
+		if (CopyReadLine(cstate))
+			return false;		/* done */
+	}
+
+	cstate->cur_lineno++;
+	done = CopyReadLine(cstate);
+
+	/* EOF at start of line means we're done, as in NextCopyFromRawFields */
+	if (done && cstate->line_buf.len == 0)
+		return false;
+
+	header.lineno = cstate->cur_lineno;
+	header.len = cstate->line_buf.len;
+	appendBinaryStringInfo(&pcopy->chunk, (char *) &header, sizeof(header));
+	appendBinaryStringInfo(&pcopy->chunk, cstate->line_buf.data, header.len);
+
+	if (pcopy->chunk.len >= PARALLEL_COPY_CHUNK_SIZE)
+		ParallelCopySendChunk(pcopy);
+
+	return !done;
+}
+
+/*
+ * Send the chunk being filled to the next worker in turn, waiting for room
+ * in its queue if need be.
+ */
+static void
+ParallelCopySendChunk(ParallelCopyLeader *pcopy)
+{
+	shm_mq_result res;
+
+	res = shm_mq_send(pcopy->queues[pcopy->next_queue],
+					  pcopy->chunk.len, pcopy->chunk.data, false);
+	if (res != SHM_MQ_SUCCESS)
+	{
+		/* The worker must have failed; report its error if it left one */
+		WaitForParallelWorkersToFinish(pcopy->pcxt);
+		ereport(ERROR,
+				(errcode(ERRCODE_INTERNAL_ERROR),
+				 errmsg("lost connection to parallel COPY worker")));
+	}
+
+	pcopy->next_queue = (pcopy->next_queue + 1) % pcopy->nqueues;
+	resetStringInfo(&pcopy->chunk);
+}
+
+/*
+ * Send the last chunk and the end markers, wait for the workers to finish,
+ * and leave parallel mode.  Returns the number of tuples the workers
+ * inserted.
+ */
+static uint64
+EndParallelCopy(ParallelCopyLeader *pcopy)
+{
+	uint64		processed;
+	int			i;
+
+	if (pcopy->chunk.len > 0)
+		ParallelCopySendChunk(pcopy);
+	for (i = 0; i < pcopy->nqueues; i++)
+	{
+		pcopy->next_queue = i;
+		ParallelCopySendChunk(pcopy);
+	}
+
+	WaitForParallelWorkersToFinish(pcopy->pcxt);
+
+	/* The workers are gone, so no need for the spinlock */
+	processed = pcopy->shared->processed;
+
+	DestroyParallelContext(pcopy->pcxt);
+	ExitParallelMode();
+	pfree(pcopy->queues);
+	pfree(pcopy->chunk.data);
+	pfree(pcopy);
+
+	return processed;
+}
+
+/*
+ * Main entry point for a parallel COPY FROM worker.
+ *
+ * The worker sets up a CopyState of its own from the leader's column list
+ * and options, and runs CopyFrom on the lines the leader sends it.  It has
+ * no lock of its own on the table; the leader's lock protects it until the
+ * worker has exited.
+ */
+static void
+ParallelCopyMain(dsm_segment *seg, shm_toc *toc)
+{
+	ParallelCopyShared *shared;
+	char	   *options;
+	char	   *queuespace;
+	shm_mq	   *mq;
+	shm_mq_handle *mqh;
+	List	   *args;
+	Relation	rel;
+	CopyState	cstate;
+	RangeTblEntry *rte;
+	ListCell   *cur;
+	uint64		processed;
+
+	shared = (ParallelCopyShared *) shm_toc_lookup(toc,
+												PARALLEL_KEY_COPY_SHARED);
+	options = shm_toc_lookup(toc, PARALLEL_KEY_COPY_OPTIONS);
+	queuespace = shm_toc_lookup(toc, PARALLEL_KEY_COPY_QUEUES);
+	if (shared == NULL || options == NULL || queuespace == NULL)
+		elog(ERROR, "could not find parallel COPY state");
+
+	mq = (shm_mq *) (queuespace +
+					 ParallelWorkerNumber * PARALLEL_COPY_QUEUE_SIZE);
+	shm_mq_set_receiver(mq, MyProc);
+	mqh = shm_mq_attach(mq, seg, NULL);
+
+	ParallelWorkerInsertsAllowed = true;
+
+	rel = heap_open(shared->relid, NoLock);
+
+	args = (List *) stringToNode(options);
+	cstate = BeginCopyFromSource(rel, NULL, false, (List *) linitial(args),
+								 (List *) lsecond(args), mqh, NULL);
+
+	/* The leader has dealt with these */
+	cstate->header_line = false;
+	cstate->freeze = false;
+	cstate->parallel_hi_options = shared->hi_options;
+
+	/* ExecConstraints wants a range table, like the one DoCopy builds */
+	rte = makeNode(RangeTblEntry);
+	rte->rtekind = RTE_RELATION;
+	rte->relid = RelationGetRelid(rel);
+	rte->relkind = rel->rd_rel->relkind;
+	rte->requiredPerms = ACL_INSERT;
+	foreach(cur, cstate->attnumlist)
+	{
+		int			attno = lfirst_int(cur) -
+		FirstLowInvalidHeapAttributeNumber;
+
+		rte->insertedCols = bms_add_member(rte->insertedCols, attno);
+	}
+	cstate->range_table = list_make1(rte);
+
+	processed = CopyFrom(cstate);
+
+	/* Report our count to the leader */
+	SpinLockAcquire(&shared->mutex);
+	shared->processed += processed;
+	SpinLockRelease(&shared->mutex);
+
+	EndCopyFrom(cstate);
+	heap_close(rel, NoLock);
+}
+
+/*
+ * Parallel COPY worker's version of CopyReadLine: get the next line from the
+ * chunks the leader sends.  The leader has already converted the line to
+ * server encoding and removed the newline.
+ *
+ * Result is true if there are no more lines.
+ */
+static bool
+CopyReadLineFromQueue(CopyState cstate)
+{
+	ParallelCopyLineHeader header;
+
+	resetStringInfo(&cstate->line_buf);
+	cstate->line_buf_valid = true;
+	cstate->line_buf_converted = true;
+
+	if (cstate->chunk_pos >= cstate->chunk_len)
+	{
+		shm_mq_result res;
+		Size		nbytes;
+		void	   *data;
+
+		if (cstate->chunk_eof)
+			return true;
+
+		res = shm_mq_receive(cstate->chunk_queue, &nbytes, &data, false);
+		if (res != SHM_MQ_SUCCESS)
+			ereport(ERROR,
+					(errcode(ERRCODE_INTERNAL_ERROR),
+					 errmsg("lost connection to parallel COPY leader")));
+		if (nbytes == 0)
+		{
+			cstate->chunk_eof = true;
+			return true;
+		}
+		cstate->chunk_data = (char *) data;
+		cstate->chunk_len = nbytes;
+		cstate->chunk_pos = 0;
+	}
+
+	/* This overrides NextCopyFromRawFields' count */
+	memcpy(&header, cstate->chunk_data + cstate->chunk_pos, sizeof(header));
+	cstate->cur_lineno = header.lineno;
+	cstate->chunk_pos += sizeof(header);
+	appendBinaryStringInfo(&cstate->line_buf,
+						   cstate->chunk_data + cstate->chunk_pos, header.len);
+	cstate->chunk_pos += header.len;
+
+	return false;
+}
+
 /*
  * Read the next input line and stash it in line_buf, with conversion to
  * server encoding.
@@ -3224,6 +3973,37 @@ CopyReadLine(CopyState cstate)
 	return result;
 }
 
+#ifdef USE_SSE2
+/*
+ * Find the first byte in s[0..len) that is one of the 'nspecial' characters
+ * in 'special' (broadcast into vectors), or that has its high bit set if
+ * 'highbit'.  Only whole vectors are examined: if none of them holds such a
+ * byte, the result is the number of bytes examined, and the caller must
+ * look at the remainder itself.
+ */
+static inline int
+CopyScanSpecial(const char *s, int len, const Vector8 *special, int nspecial,
+				bool highbit)
+{
+	int			i;
+
+	for (i = 0; i + (int) sizeof(Vector8) <= len; i += sizeof(Vector8))
+	{
+		Vector8		chunk = vector8_load(s + i);
+		Vector8		hits = highbit ? chunk : vector8_zero();
+		uint32		mask;
+		int			j;
+
+		for (j = 0; j < nspecial; j++)
+			hits = vector8_or(hits, vector8_eq(chunk, special[j]));
+		mask = vector8_highbit_mask(hits);
+		if (mask != 0)
+			return i + vector8_mask_first(mask);
+	}
+	return i;
+}
+#endif   /* USE_SSE2 */
+
 /*
  * CopyReadLineText - inner loop of CopyReadLine for text mode
  */
@@ -3245,6 +4025,11 @@ CopyReadLineText(CopyState cstate)
 	char		quotec = '\0';
 	char		escapec = '\0';
 
+#ifdef USE_SSE2
+	Vector8		special[5];
+	int			nspecial = 0;
+#endif
+
 	if (cstate->csv_mode)
 	{
 		quotec = cstate->quote[0];
@@ -3256,6 +4041,18 @@ CopyReadLineText(CopyState cstate)
 
 	mblen_str[1] = '\0';
 
+#ifdef USE_SSE2
+	/* The characters that stop the fast scan below */
+	special[nspecial++] = vector8_broadcast('\n');
+	special[nspecial++] = vector8_broadcast('\r');
+	special[nspecial++] = vector8_broadcast('\\');
+	if (cstate->csv_mode)
+	{
+		special[nspecial++] = vector8_broadcast(quotec);
+		special[nspecial++] = vector8_broadcast(escapec);
+	}
+#endif
+
 	/*
 	 * The objective of this loop is to transfer the entire next input line
 	 * into line_buf.  Hence, we only care for detecting newlines (\r and/or
@@ -3321,6 +4118,33 @@ CopyReadLineText(CopyState cstate)
 			need_data = false;
 		}
 
+#ifdef USE_SSE2
+
+		/*
+		 * Skip over bytes that can't end the line, or change the CSV quoting
+		 * state, a vector at a time.  The code below takes over at the first
+		 * byte that might matter, including the first byte of a multibyte
+		 * character in an encoding that embeds ASCII.  Skipping any bytes at
+		 * all means we're past the first character and the last escape.
+		 */
+		{
+			int			skip;
+
+			skip = CopyScanSpecial(copy_raw_buf + raw_buf_ptr,
+								   copy_buf_len - raw_buf_ptr,
+								   special, nspecial,
+								   cstate->encoding_embeds_ascii);
+			if (skip > 0)
+			{
+				raw_buf_ptr += skip;
+				first_char_in_line = false;
+				last_was_esc = false;
+				if (raw_buf_ptr >= copy_buf_len)
+					continue;
+			}
+		}
+#endif
+
 		/* OK to fetch a character */
 		prev_raw_ptr = raw_buf_ptr;
 		c = copy_raw_buf[raw_buf_ptr++];
@@ -3623,6 +4447,13 @@ CopyReadAttributesText(CopyState cstate)
 	char	   *cur_ptr;
 	char	   *line_end_ptr;
 
+#ifdef USE_SSE2
+	Vector8		special[2];
+
+	special[0] = vector8_broadcast(delimc);
+	special[1] = vector8_broadcast('\\');
+#endif
+
 	/*
 	 * We need a special case for zero-column tables: check that the input
 	 * line is empty, and return.
@@ -3690,6 +4521,19 @@ CopyReadAttributesText(CopyState cstate)
 		{
 			char		c;
 
+#ifdef USE_SSE2
+			/* Copy a run of bytes with no delimiter or backslash in one go */
+			{
+				int			n;
+
+				n = CopyScanSpecial(cur_ptr, line_end_ptr - cur_ptr,
+									special, 2, false);
+				memcpy(output_ptr, cur_ptr, n);
+				output_ptr += n;
+				cur_ptr += n;
+			}
+#endif
+
 			end_ptr = cur_ptr;
 			if (cur_ptr >= line_end_ptr)
 				break;
@@ -3853,6 +4697,16 @@ CopyReadAttributesCSV(CopyState cstate)
 	char	   *cur_ptr;
 	char	   *line_end_ptr;
 
+#ifdef USE_SSE2
+	Vector8		unquoted_special[2];
+	Vector8		quoted_special[2];
+
+	unquoted_special[0] = vector8_broadcast(delimc);
+	unquoted_special[1] = vector8_broadcast(quotec);
+	quoted_special[0] = vector8_broadcast(quotec);
+	quoted_special[1] = vector8_broadcast(escapec);
+#endif
+
 	/*
 	 * We need a special case for zero-column tables: check that the input
 	 * line is empty, and return.
@@ -3919,6 +4773,19 @@ CopyReadAttributesCSV(CopyState cstate)
 			/* Not in quote */
 			for (;;)
 			{
+#ifdef USE_SSE2
+				/* Copy a run of ordinary bytes in one go */
+				{
+					int			n;
+
+					n = CopyScanSpecial(cur_ptr, line_end_ptr - cur_ptr,
+										unquoted_special, 2, false);
+					memcpy(output_ptr, cur_ptr, n);
+					output_ptr += n;
+					cur_ptr += n;
+				}
+#endif
+
 				end_ptr = cur_ptr;
 				if (cur_ptr >= line_end_ptr)
 					goto endfield;
@@ -3942,6 +4809,19 @@ CopyReadAttributesCSV(CopyState cstate)
 			/* In quote */
 			for (;;)
 			{
+#ifdef USE_SSE2
+				/* Likewise, up to the next quote or escape */
+				{
+					int			n;
+
+					n = CopyScanSpecial(cur_ptr, line_end_ptr - cur_ptr,
+										quoted_special, 2, false);
+					memcpy(output_ptr, cur_ptr, n);
+					output_ptr += n;
+					cur_ptr += n;
+				}
+#endif
+
 				end_ptr = cur_ptr;
 				if (cur_ptr >= line_end_ptr)
 					ereport(ERROR,
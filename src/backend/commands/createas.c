@@ -103,6 +103,19 @@ ExecCreateTableAs(CreateTableAsStmt *stmt, const char *queryString,
 		}
 	}
 
+	/*
+	 * An incrementally maintained materialized view gets the columns its
+	 * maintenance needs added to its query, both the one computing its data
+	 * and the one stored for it.
+	 */
+	if (into->incremental)
+	{
+		Assert(is_matview);
+		into = (IntoClause *) copyObject(into);
+		query = PrepareIncrementalMatViewQuery(query, into->colNames);
+		into->viewQuery = (Node *) copyObject(query);
+	}
+
 	/*
 	 * Create the tuple receiver object and insert info it will need
 	 */
@@ -170,8 +183,15 @@ ExecCreateTableAs(CreateTableAsStmt *stmt, const char *queryString,
 	 * the planner executed an allegedly-stable function that changed the
 	 * database contents, but let's do it anyway to be parallel to the EXPLAIN
 	 * code path.)
+	 *
+	 * An incrementally maintained view must start out with the changes that
+	 * committed while we waited for the locks on its tables, since its
+	 * triggers will only see the ones after.
 	 */
-	PushCopiedSnapshot(GetActiveSnapshot());
+	if (into->incremental)
+		PushCopiedSnapshot(GetLatestSnapshot());
+	else
+		PushCopiedSnapshot(GetActiveSnapshot());
 	UpdateActiveSnapshotCommandId();
 
 	/* Create a QueryDesc, redirecting output to our tuple receiver */
@@ -219,6 +239,10 @@ ExecCreateTableAs(CreateTableAsStmt *stmt, const char *queryString,
 	address = CreateAsReladdr;
 	CreateAsReladdr = InvalidObjectAddress;
 
+	if (into->incremental)
+		CreateIncrementalMatViewTriggers((Query *) into->viewQuery,
+										 address.objectId);
+
 	return address;
 }
 
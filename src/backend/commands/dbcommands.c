@@ -19,6 +19,7 @@
  */
 #include "postgres.h"
 
+#include <ctype.h>
 #include <fcntl.h>
 #include <locale.h>
 #include <unistd.h>
@@ -28,6 +29,7 @@
 #include "access/heapam.h"
 #include "access/htup_details.h"
 #include "access/xact.h"
+#include "access/xlog.h"
 #include "access/xloginsert.h"
 #include "access/xlogutils.h"
 #include "catalog/catalog.h"
@@ -38,17 +40,21 @@
 #include "catalog/pg_database.h"
 #include "catalog/pg_db_role_setting.h"
 #include "catalog/pg_tablespace.h"
+#include "catalog/storage_xlog.h"
 #include "commands/comment.h"
 #include "commands/dbcommands.h"
 #include "commands/dbcommands_xlog.h"
 #include "commands/defrem.h"
 #include "commands/seclabel.h"
+#include "commands/sequence.h"
 #include "commands/tablespace.h"
+#include "common/relpath.h"
 #include "mb/pg_wchar.h"
 #include "miscadmin.h"
 #include "pgstat.h"
 #include "postmaster/bgwriter.h"
 #include "replication/slot.h"
+#include "storage/bufmgr.h"
 #include "storage/copydir.h"
 #include "storage/fd.h"
 #include "storage/lmgr.h"
@@ -59,11 +65,31 @@
 #include "utils/builtins.h"
 #include "utils/fmgroids.h"
 #include "utils/pg_locale.h"
+#include "utils/relmapper.h"
+#include "utils/sharedcatcache.h"
+#include "utils/sharedplancache.h"
 #include "utils/snapmgr.h"
 #include "utils/syscache.h"
 #include "utils/tqual.h"
 
 
+/*
+ * How CREATE DATABASE copies the template database.
+ *
+ * CREATEDB_WAL_LOG copies the relations of the template block by block,
+ * reading them through the buffer pool and WAL-logging every block, so that
+ * nothing needs to be flushed beforehand and replay needs no access to the
+ * template.  CREATEDB_FILE_COPY copies the template's directories file by
+ * file, which is cheaper for large templates, but needs a checkpoint before
+ * the copy to get the template's data on disk and one afterwards so that
+ * the copy is never replayed, see createdb().
+ */
+typedef enum CreateDBStrategy
+{
+	CREATEDB_WAL_LOG,
+	CREATEDB_FILE_COPY
+} CreateDBStrategy;
+
 typedef struct
 {
 	Oid			src_dboid;		/* source (template) DB */
@@ -76,8 +102,23 @@ typedef struct
 	Oid			dest_tsoid;		/* tablespace we are trying to move to */
 } movedb_failure_params;
 
+/* GUC variable */
+int			create_database_wal_log_limit = 16384;
+
 /* non-export function prototypes */
 static void createdb_failure_callback(int code, Datum arg);
+static int64 get_database_files_size(Oid db_id);
+static void CreateDatabaseUsingFileCopy(Oid src_dboid, Oid dst_dboid,
+							Oid src_tsid, Oid dst_tsid);
+static void CreateDatabaseUsingWalLog(Oid src_dboid, Oid dst_dboid,
+						  Oid src_tsid, Oid dst_tsid);
+static void CreateDirAndVersionFile(Oid db_id, Oid tsid, bool isRedo);
+static void copy_database_dir_using_wal_log(char *srcpath,
+								Oid src_dboid, Oid src_tsid,
+								Oid dst_dboid, Oid dst_tsid,
+								BufferAccessStrategy bstrategy);
+static bool parse_relation_filename(const char *name, Oid *relNode,
+						ForkNumber *forkNum);
 static void movedb(const char *dbname, const char *tblspcname);
 static void movedb_failure_callback(int code, Datum arg);
 static bool get_db_info(const char *name, LOCKMODE lockmode,
@@ -98,8 +139,6 @@ static int	errdetail_busy_db(int notherbackends, int npreparedxacts);
 Oid
 createdb(const CreatedbStmt *stmt)
 {
-	HeapScanDesc scan;
-	Relation	rel;
 	Oid			src_dboid;
 	Oid			src_owner;
 	int			src_encoding;
@@ -128,6 +167,7 @@ createdb(const CreatedbStmt *stmt)
 	DefElem    *distemplate = NULL;
 	DefElem    *dallowconnections = NULL;
 	DefElem    *dconnlimit = NULL;
+	DefElem    *dstrategy = NULL;
 	char	   *dbname = stmt->dbname;
 	char	   *dbowner = NULL;
 	const char *dbtemplate = NULL;
@@ -138,6 +178,8 @@ createdb(const CreatedbStmt *stmt)
 	bool		dbistemplate = false;
 	bool		dballowconnections = true;
 	int			dbconnlimit = -1;
+	CreateDBStrategy dbstrategy;
+	bool		dbstrategy_given = false;
 	int			notherbackends;
 	int			npreparedxacts;
 	createdb_failure_params fparms;
@@ -219,6 +261,14 @@ createdb(const CreatedbStmt *stmt)
 						 errmsg("conflicting or redundant options")));
 			dconnlimit = defel;
 		}
+		else if (strcmp(defel->defname, "strategy") == 0)
+		{
+			if (dstrategy)
+				ereport(ERROR,
+						(errcode(ERRCODE_SYNTAX_ERROR),
+						 errmsg("conflicting or redundant options")));
+			dstrategy = defel;
+		}
 		else if (strcmp(defel->defname, "location") == 0)
 		{
 			ereport(WARNING,
@@ -278,6 +328,22 @@ createdb(const CreatedbStmt *stmt)
 					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
 					 errmsg("invalid connection limit: %d", dbconnlimit)));
 	}
+	if (dstrategy && dstrategy->arg)
+	{
+		char	   *strategy = defGetString(dstrategy);
+
+		if (pg_strcasecmp(strategy, "wal_log") == 0)
+			dbstrategy = CREATEDB_WAL_LOG;
+		else if (pg_strcasecmp(strategy, "file_copy") == 0)
+			dbstrategy = CREATEDB_FILE_COPY;
+		else
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("invalid create database strategy \"%s\"",
+							strategy),
+					 errhint("Valid strategies are \"wal_log\" and \"file_copy\".")));
+		dbstrategy_given = true;
+	}
 
 	/* obtain OID of proposed owner */
 	if (dbowner)
@@ -482,6 +548,20 @@ createdb(const CreatedbStmt *stmt)
 				   dbtemplate),
 				 errdetail_busy_db(notherbackends, npreparedxacts)));
 
+	/*
+	 * Unless told otherwise, copy small templates through WAL, which is
+	 * cheap for them and spares the rest of the system two checkpoints.
+	 */
+	if (!dbstrategy_given)
+	{
+		if (create_database_wal_log_limit >= 0 &&
+			get_database_files_size(src_dboid) <=
+			(int64) create_database_wal_log_limit * 1024)
+			dbstrategy = CREATEDB_WAL_LOG;
+		else
+			dbstrategy = CREATEDB_FILE_COPY;
+	}
+
 	/*
 	 * Select an OID for the new database, checking that it doesn't have a
 	 * filename conflict with anything already existing in the tablespace
@@ -551,17 +631,19 @@ createdb(const CreatedbStmt *stmt)
 	InvokeObjectPostCreateHook(DatabaseRelationId, dboid, 0);
 
 	/*
-	 * Force a checkpoint before starting the copy. This will force all dirty
-	 * buffers, including those of unlogged tables, out to disk, to ensure
-	 * source database is up-to-date on disk for the copy.
+	 * Force a checkpoint before starting a file copy. This will force all
+	 * dirty buffers, including those of unlogged tables, out to disk, to
+	 * ensure source database is up-to-date on disk for the copy.
 	 * FlushDatabaseBuffers() would suffice for that, but we also want to
 	 * process any pending unlink requests. Otherwise, if a checkpoint
 	 * happened while we're copying files, a file might be deleted just when
 	 * we're about to copy it, causing the lstat() call in copydir() to fail
-	 * with ENOENT.
+	 * with ENOENT.  Copying through WAL reads the blocks through the buffer
+	 * pool instead, so it doesn't need any of this.
 	 */
-	RequestCheckpoint(CHECKPOINT_IMMEDIATE | CHECKPOINT_FORCE | CHECKPOINT_WAIT
-					  | CHECKPOINT_FLUSH_ALL);
+	if (dbstrategy == CREATEDB_FILE_COPY)
+		RequestCheckpoint(CHECKPOINT_IMMEDIATE | CHECKPOINT_FORCE |
+						  CHECKPOINT_WAIT | CHECKPOINT_FLUSH_ALL);
 
 	/*
 	 * Once we start copying subdirectories, we need to be able to clean 'em
@@ -575,115 +657,477 @@ createdb(const CreatedbStmt *stmt)
 	PG_ENSURE_ERROR_CLEANUP(createdb_failure_callback,
 							PointerGetDatum(&fparms));
 	{
+		if (dbstrategy == CREATEDB_WAL_LOG)
+			CreateDatabaseUsingWalLog(src_dboid, dboid, src_deftablespace,
+									  dst_deftablespace);
+		else
+			CreateDatabaseUsingFileCopy(src_dboid, dboid, src_deftablespace,
+										dst_deftablespace);
+
 		/*
-		 * Iterate through all tablespaces of the template database, and copy
-		 * each one to the new database.
+		 * Close pg_database, but keep lock till commit.
 		 */
-		rel = heap_open(TableSpaceRelationId, AccessShareLock);
-		scan = heap_beginscan_catalog(rel, 0, NULL);
-		while ((tuple = heap_getnext(scan, ForwardScanDirection)) != NULL)
-		{
-			Oid			srctablespace = HeapTupleGetOid(tuple);
-			Oid			dsttablespace;
-			char	   *srcpath;
-			char	   *dstpath;
-			struct stat st;
-
-			/* No need to copy global tablespace */
-			if (srctablespace == GLOBALTABLESPACE_OID)
-				continue;
+		heap_close(pg_database_rel, NoLock);
 
-			srcpath = GetDatabasePath(src_dboid, srctablespace);
+		/*
+		 * Force synchronous commit, thus minimizing the window between
+		 * creation of the database files and commital of the transaction. If
+		 * we crash before committing, we'll have a DB that's taking up disk
+		 * space but is not in pg_database, which is not good.
+		 */
+		ForceSyncCommit();
+	}
+	PG_END_ENSURE_ERROR_CLEANUP(createdb_failure_callback,
+								PointerGetDatum(&fparms));
 
-			if (stat(srcpath, &st) < 0 || !S_ISDIR(st.st_mode) ||
-				directory_is_empty(srcpath))
-			{
-				/* Assume we can ignore it */
-				pfree(srcpath);
-				continue;
-			}
+	return dboid;
+}
 
-			if (srctablespace == src_deftablespace)
-				dsttablespace = dst_deftablespace;
-			else
-				dsttablespace = srctablespace;
+/*
+ * Copy the template database src_dboid to dst_dboid directory by directory,
+ * for CREATEDB_FILE_COPY.  src_tsid and dst_tsid are the default tablespaces
+ * of the two databases.
+ */
+static void
+CreateDatabaseUsingFileCopy(Oid src_dboid, Oid dst_dboid,
+							Oid src_tsid, Oid dst_tsid)
+{
+	Relation	rel;
+	HeapScanDesc scan;
+	HeapTuple	tuple;
 
-			dstpath = GetDatabasePath(dboid, dsttablespace);
+	/*
+	 * Iterate through all tablespaces of the template database, and copy
+	 * each one to the new database.
+	 */
+	rel = heap_open(TableSpaceRelationId, AccessShareLock);
+	scan = heap_beginscan_catalog(rel, 0, NULL);
+	while ((tuple = heap_getnext(scan, ForwardScanDirection)) != NULL)
+	{
+		Oid			srctablespace = HeapTupleGetOid(tuple);
+		Oid			dsttablespace;
+		char	   *srcpath;
+		char	   *dstpath;
+		struct stat st;
 
-			/*
-			 * Copy this subdirectory to the new location
-			 *
-			 * We don't need to copy subdirectories
-			 */
-			copydir(srcpath, dstpath, false);
+		/* No need to copy global tablespace */
+		if (srctablespace == GLOBALTABLESPACE_OID)
+			continue;
 
-			/* Record the filesystem change in XLOG */
-			{
-				xl_dbase_create_rec xlrec;
+		srcpath = GetDatabasePath(src_dboid, srctablespace);
 
-				xlrec.db_id = dboid;
-				xlrec.tablespace_id = dsttablespace;
-				xlrec.src_db_id = src_dboid;
-				xlrec.src_tablespace_id = srctablespace;
+		if (stat(srcpath, &st) < 0 || !S_ISDIR(st.st_mode) ||
+			directory_is_empty(srcpath))
+		{
+			/* Assume we can ignore it */
+			pfree(srcpath);
+			continue;
+		}
 
-				XLogBeginInsert();
-				XLogRegisterData((char *) &xlrec, sizeof(xl_dbase_create_rec));
+		if (srctablespace == src_tsid)
+			dsttablespace = dst_tsid;
+		else
+			dsttablespace = srctablespace;
 
-				(void) XLogInsert(RM_DBASE_ID,
-								  XLOG_DBASE_CREATE | XLR_SPECIAL_REL_UPDATE);
-			}
-		}
-		heap_endscan(scan);
-		heap_close(rel, AccessShareLock);
+		dstpath = GetDatabasePath(dst_dboid, dsttablespace);
 
 		/*
-		 * We force a checkpoint before committing.  This effectively means
-		 * that committed XLOG_DBASE_CREATE operations will never need to be
-		 * replayed (at least not in ordinary crash recovery; we still have to
-		 * make the XLOG entry for the benefit of PITR operations). This
-		 * avoids two nasty scenarios:
-		 *
-		 * #1: When PITR is off, we don't XLOG the contents of newly created
-		 * indexes; therefore the drop-and-recreate-whole-directory behavior
-		 * of DBASE_CREATE replay would lose such indexes.
-		 *
-		 * #2: Since we have to recopy the source database during DBASE_CREATE
-		 * replay, we run the risk of copying changes in it that were
-		 * committed after the original CREATE DATABASE command but before the
-		 * system crash that led to the replay.  This is at least unexpected
-		 * and at worst could lead to inconsistencies, eg duplicate table
-		 * names.
-		 *
-		 * (Both of these were real bugs in releases 8.0 through 8.0.3.)
-		 *
-		 * In PITR replay, the first of these isn't an issue, and the second
-		 * is only a risk if the CREATE DATABASE and subsequent template
-		 * database change both occur while a base backup is being taken.
-		 * There doesn't seem to be much we can do about that except document
-		 * it as a limitation.
+		 * Copy this subdirectory to the new location
 		 *
-		 * Perhaps if we ever implement CREATE DATABASE in a less cheesy way,
-		 * we can avoid this.
+		 * We don't need to copy subdirectories
 		 */
-		RequestCheckpoint(CHECKPOINT_IMMEDIATE | CHECKPOINT_FORCE | CHECKPOINT_WAIT);
+		copydir(srcpath, dstpath, false);
+
+		/* Record the filesystem change in XLOG */
+		{
+			xl_dbase_create_rec xlrec;
+
+			xlrec.db_id = dst_dboid;
+			xlrec.tablespace_id = dsttablespace;
+			xlrec.src_db_id = src_dboid;
+			xlrec.src_tablespace_id = srctablespace;
+
+			XLogBeginInsert();
+			XLogRegisterData((char *) &xlrec, sizeof(xl_dbase_create_rec));
+
+			(void) XLogInsert(RM_DBASE_ID,
+							  XLOG_DBASE_CREATE | XLR_SPECIAL_REL_UPDATE);
+		}
+	}
+	heap_endscan(scan);
+	heap_close(rel, AccessShareLock);
+
+	/*
+	 * We force a checkpoint before committing.  This effectively means
+	 * that committed XLOG_DBASE_CREATE operations will never need to be
+	 * replayed (at least not in ordinary crash recovery; we still have to
+	 * make the XLOG entry for the benefit of PITR operations). This
+	 * avoids two nasty scenarios:
+	 *
+	 * #1: When PITR is off, we don't XLOG the contents of newly created
+	 * indexes; therefore the drop-and-recreate-whole-directory behavior
+	 * of DBASE_CREATE replay would lose such indexes.
+	 *
+	 * #2: Since we have to recopy the source database during DBASE_CREATE
+	 * replay, we run the risk of copying changes in it that were
+	 * committed after the original CREATE DATABASE command but before the
+	 * system crash that led to the replay.  This is at least unexpected
+	 * and at worst could lead to inconsistencies, eg duplicate table
+	 * names.
+	 *
+	 * (Both of these were real bugs in releases 8.0 through 8.0.3.)
+	 *
+	 * In PITR replay, the first of these isn't an issue, and the second
+	 * is only a risk if the CREATE DATABASE and subsequent template
+	 * database change both occur while a base backup is being taken.
+	 * There doesn't seem to be much we can do about that except document
+	 * it as a limitation.
+	 *
+	 * CREATEDB_WAL_LOG avoids all this by WAL-logging the contents of the
+	 * copy instead.
+	 */
+	RequestCheckpoint(CHECKPOINT_IMMEDIATE | CHECKPOINT_FORCE | CHECKPOINT_WAIT);
+}
+
+/*
+ * Copy the template database src_dboid to dst_dboid relation fork by
+ * relation fork, for CREATEDB_WAL_LOG.  src_tsid and dst_tsid are the
+ * default tablespaces of the two databases.
+ */
+static void
+CreateDatabaseUsingWalLog(Oid src_dboid, Oid dst_dboid,
+						  Oid src_tsid, Oid dst_tsid)
+{
+	Relation	rel;
+	HeapScanDesc scan;
+	HeapTuple	tuple;
+	BufferAccessStrategy bstrategy;
+	char	   *srcpath;
+	char	   *dstpath;
+
+	/*
+	 * Create the database directory in the default tablespace, and its
+	 * version file, first; the directories in other tablespaces are created
+	 * along with the first relation in them, also during replay.
+	 */
+	CreateDirAndVersionFile(dst_dboid, dst_tsid, false);
+
+	/* Don't let the copy push the rest of the buffer pool out */
+	bstrategy = GetAccessStrategy(BAS_BULKREAD);
+
+	rel = heap_open(TableSpaceRelationId, AccessShareLock);
+	scan = heap_beginscan_catalog(rel, 0, NULL);
+	while ((tuple = heap_getnext(scan, ForwardScanDirection)) != NULL)
+	{
+		Oid			srctablespace = HeapTupleGetOid(tuple);
+		Oid			dsttablespace;
+		struct stat st;
+
+		/* No need to copy global tablespace */
+		if (srctablespace == GLOBALTABLESPACE_OID)
+			continue;
+
+		srcpath = GetDatabasePath(src_dboid, srctablespace);
+
+		if (stat(srcpath, &st) < 0 || !S_ISDIR(st.st_mode) ||
+			directory_is_empty(srcpath))
+		{
+			/* Assume we can ignore it */
+			pfree(srcpath);
+			continue;
+		}
+
+		if (srctablespace == src_tsid)
+			dsttablespace = dst_tsid;
+		else
+			dsttablespace = srctablespace;
+
+		copy_database_dir_using_wal_log(srcpath, src_dboid, srctablespace,
+										dst_dboid, dsttablespace, bstrategy);
+		pfree(srcpath);
+	}
+	heap_endscan(scan);
+	heap_close(rel, AccessShareLock);
+
+	FreeAccessStrategy(bstrategy);
+
+	/*
+	 * The mapped catalogs have kept their filenodes, so the new database can
+	 * use a copy of the template's relation map.
+	 */
+	srcpath = GetDatabasePath(src_dboid, src_tsid);
+	dstpath = GetDatabasePath(dst_dboid, dst_tsid);
+	RelationMapCopy(dst_dboid, dst_tsid, srcpath, dstpath);
+	pfree(srcpath);
+	pfree(dstpath);
+}
+
+/*
+ * Create the directory of database db_id in tablespace tsid, and write its
+ * PG_VERSION file, WAL-logging that unless isRedo.
+ */
+static void
+CreateDirAndVersionFile(Oid db_id, Oid tsid, bool isRedo)
+{
+	char	   *dbpath;
+	char		versionfile[MAXPGPATH];
+	char		buf[16];
+	int			nbytes;
+	int			fd;
+
+	TablespaceCreateDbspace(tsid, db_id, isRedo);
+
+	if (!isRedo)
+	{
+		xl_dbase_create_wal_log_rec xlrec;
+		XLogRecPtr	lsn;
+
+		xlrec.db_id = db_id;
+		xlrec.tablespace_id = tsid;
+
+		XLogBeginInsert();
+		XLogRegisterData((char *) &xlrec, sizeof(xl_dbase_create_wal_log_rec));
+
+		lsn = XLogInsert(RM_DBASE_ID, XLOG_DBASE_CREATE_WAL_LOG);
+
+		/* As always, WAL must hit the disk before the data update does */
+		XLogFlush(lsn);
+	}
+
+	dbpath = GetDatabasePath(db_id, tsid);
+	snprintf(versionfile, sizeof(versionfile), "%s/PG_VERSION", dbpath);
+	nbytes = snprintf(buf, sizeof(buf), "%s\n", PG_MAJORVERSION);
+
+	fd = OpenTransientFile(versionfile, O_WRONLY | O_CREAT | O_TRUNC | PG_BINARY,
+						   S_IRUSR | S_IWUSR);
+	if (fd < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not create file \"%s\": %m", versionfile)));
+
+	errno = 0;
+	if ((int) write(fd, buf, nbytes) != nbytes)
+	{
+		/* if write didn't set errno, assume problem is no disk space */
+		if (errno == 0)
+			errno = ENOSPC;
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write to file \"%s\": %m", versionfile)));
+	}
+
+	if (pg_fsync(fd) != 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not fsync file \"%s\": %m", versionfile)));
+
+	if (CloseTransientFile(fd))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not close file \"%s\": %m", versionfile)));
+
+	fsync_fname(dbpath, true);
+	pfree(dbpath);
+}
+
+/*
+ * Copy all relation forks found in the template's directory srcpath, in
+ * tablespace src_tsid, to the same relfilenodes in dst_dboid and dst_tsid.
+ *
+ * The blocks are read through the buffer pool, so that we see changes not
+ * yet written out, and written to the new files directly.  The forks of
+ * permanent relations, and the init forks of unlogged ones, are WAL-logged
+ * block by block if WAL archiving or streaming is enabled, and synced to
+ * disk before we're done, like copy_relation_data() in tablecmds.c does;
+ * the other forks of unlogged relations are reset from their init forks
+ * after a crash anyway.
+ */
+static void
+copy_database_dir_using_wal_log(char *srcpath,
+								Oid src_dboid, Oid src_tsid,
+								Oid dst_dboid, Oid dst_tsid,
+								BufferAccessStrategy bstrategy)
+{
+	DIR		   *dir;
+	struct dirent *de;
+	char	   *buf;
+
+	/* palloc the buffer so that it's MAXALIGN'd, see copy_relation_data() */
+	buf = (char *) palloc(BLCKSZ);
+
+	dir = AllocateDir(srcpath);
+	while ((de = ReadDir(dir, srcpath)) != NULL)
+	{
+		RelFileNode src_rnode;
+		RelFileNode dst_rnode;
+		SMgrRelation src;
+		SMgrRelation dst;
+		ForkNumber	forkNum;
+		BlockNumber nblocks;
+		BlockNumber blkno;
+		bool		permanent;
+		bool		use_wal;
+
+		/* Skip PG_VERSION, the relation map, segment and temporary files */
+		if (!parse_relation_filename(de->d_name, &src_rnode.relNode, &forkNum))
+			continue;
+
+		src_rnode.spcNode = src_tsid;
+		src_rnode.dbNode = src_dboid;
+		dst_rnode.spcNode = dst_tsid;
+		dst_rnode.dbNode = dst_dboid;
+		dst_rnode.relNode = src_rnode.relNode;
+
+		src = smgropen(src_rnode, InvalidBackendId);
 
 		/*
-		 * Close pg_database, but keep lock till commit.
+		 * A file can vanish under us only if it's left over from a dropped
+		 * relation, and was just unlinked by a checkpoint.
 		 */
-		heap_close(pg_database_rel, NoLock);
+		if (!smgrexists(src, forkNum))
+			continue;
+
+		/* Unlogged relations are the ones with an init fork */
+		permanent = !smgrexists(src, INIT_FORKNUM);
+		use_wal = XLogIsNeeded() && (permanent || forkNum == INIT_FORKNUM);
+
+		dst = smgropen(dst_rnode, InvalidBackendId);
+		smgrcreate(dst, forkNum, false);
+		if (permanent || forkNum == INIT_FORKNUM)
+			log_smgrcreate(&dst_rnode, forkNum);
+
+		nblocks = smgrnblocks(src, forkNum);
+
+		for (blkno = 0; blkno < nblocks; blkno++)
+		{
+			Buffer		srcbuf;
+
+			/* If we got a cancel signal during the copy of the data, quit */
+			CHECK_FOR_INTERRUPTS();
+
+			srcbuf = ReadBufferWithoutRelcache(src_rnode, forkNum, blkno,
+											   RBM_NORMAL, bstrategy);
+			LockBuffer(srcbuf, BUFFER_LOCK_SHARE);
+			memcpy(buf, BufferGetPage(srcbuf), BLCKSZ);
+			UnlockReleaseBuffer(srcbuf);
+
+			/*
+			 * WAL-log the copied page.  We don't know what kind of a page
+			 * this is, so we have to log the full page including any unused
+			 * space.
+			 */
+			if (use_wal)
+				log_newpage(&dst_rnode, forkNum, blkno, (Page) buf, false);
+
+			PageSetChecksumInplace((Page) buf, blkno);
+
+			/*
+			 * Now write the page.  There's no need for smgr to schedule an
+			 * fsync for this write; we'll do it ourselves below.
+			 */
+			smgrextend(dst, forkNum, blkno, buf, true);
+		}
 
 		/*
-		 * Force synchronous commit, thus minimizing the window between
-		 * creation of the database files and commital of the transaction. If
-		 * we crash before committing, we'll have a DB that's taking up disk
-		 * space but is not in pg_database, which is not good.
+		 * As in copy_relation_data(), the data must be on disk before we
+		 * commit, since a checkpoint may already have passed the WAL records
+		 * for it.
 		 */
-		ForceSyncCommit();
+		if (permanent || forkNum == INIT_FORKNUM)
+			smgrimmedsync(dst, forkNum);
+
+		smgrclose(dst);
 	}
-	PG_END_ENSURE_ERROR_CLEANUP(createdb_failure_callback,
-								PointerGetDatum(&fparms));
+	FreeDir(dir);
 
-	return dboid;
+	pfree(buf);
+}
+
+/*
+ * Parse the name of a file in a database directory as that of a relation
+ * fork, "<relfilenode>" or "<relfilenode>_<forkname>".  Returns false for
+ * anything else, including segments beyond the first of a fork, which the
+ * smgr takes care of, and the files of temporary relations.
+ */
+static bool
+parse_relation_filename(const char *name, Oid *relNode, ForkNumber *forkNum)
+{
+	int			pos;
+
+	for (pos = 0; isdigit((unsigned char) name[pos]); pos++)
+		;
+	if (pos == 0 || pos > OIDCHARS)
+		return false;
+
+	if (name[pos] == '_')
+	{
+		int			forkchar = forkname_chars(&name[pos + 1], forkNum);
+
+		if (forkchar <= 0)
+			return false;
+		pos += forkchar + 1;
+	}
+	else
+		*forkNum = MAIN_FORKNUM;
+
+	if (name[pos] != '\0')
+		return false;
+
+	*relNode = (Oid) strtoul(name, NULL, 10);
+	return true;
+}
+
+/*
+ * Total size of the files of a database in all tablespaces, as CREATE
+ * DATABASE sees it for choosing how to copy it.
+ */
+static int64
+get_database_files_size(Oid db_id)
+{
+	Relation	rel;
+	HeapScanDesc scan;
+	HeapTuple	tuple;
+	int64		totalsize = 0;
+
+	rel = heap_open(TableSpaceRelationId, AccessShareLock);
+	scan = heap_beginscan_catalog(rel, 0, NULL);
+	while ((tuple = heap_getnext(scan, ForwardScanDirection)) != NULL)
+	{
+		Oid			tsid = HeapTupleGetOid(tuple);
+		char	   *dbpath;
+		DIR		   *dir;
+		struct dirent *de;
+
+		if (tsid == GLOBALTABLESPACE_OID)
+			continue;
+
+		dbpath = GetDatabasePath(db_id, tsid);
+		dir = AllocateDir(dbpath);
+		if (dir == NULL)
+		{
+			/* the database has nothing in this tablespace */
+			pfree(dbpath);
+			continue;
+		}
+
+		while ((de = ReadDir(dir, dbpath)) != NULL)
+		{
+			char		filename[MAXPGPATH];
+			struct stat st;
+
+			snprintf(filename, sizeof(filename), "%s/%s", dbpath, de->d_name);
+
+			/* files can be unlinked concurrently; just skip them */
+			if (lstat(filename, &st) == 0 && S_ISREG(st.st_mode))
+				totalsize += st.st_size;
+		}
+		FreeDir(dir);
+		pfree(dbpath);
+	}
+	heap_endscan(scan);
+	heap_close(rel, AccessShareLock);
+
+	return totalsize;
 }
 
 /*
@@ -895,6 +1339,15 @@ dropdb(const char *dbname, bool missing_ok)
 	 */
 	DropDatabaseBuffers(db_id);
 
+	/*
+	 * Likewise forget its tuples, plans and sequence values in the shared
+	 * catalog, plan and sequence caches, lest a new database that happens to
+	 * get the same OID find them.
+	 */
+	SharedCatCacheInvalidateDatabase(db_id);
+	SharedPlanCacheInvalidateDatabase(db_id);
+	ForgetSharedSequenceCaches(db_id, InvalidOid);
+
 	/*
 	 * Tell the stats collector to forget it immediately, too.
 	 */
@@ -2086,6 +2539,14 @@ dbase_redo(XLogReaderState *record)
 		 */
 		copydir(src_path, dst_path, false);
 	}
+	else if (info == XLOG_DBASE_CREATE_WAL_LOG)
+	{
+		xl_dbase_create_wal_log_rec *xlrec =
+		(xl_dbase_create_wal_log_rec *) XLogRecGetData(record);
+
+		/* The contents follow as WAL records of their own */
+		CreateDirAndVersionFile(xlrec->db_id, xlrec->tablespace_id, true);
+	}
 	else if (info == XLOG_DBASE_DROP)
 	{
 		xl_dbase_drop_rec *xlrec = (xl_dbase_drop_rec *) XLogRecGetData(record);
@@ -13,6 +13,7 @@
  */
 #include "postgres.h"
 
+#include "access/hash.h"
 #include "access/xact.h"
 #include "catalog/pg_collation.h"
 #include "catalog/pg_type.h"
@@ -30,6 +31,7 @@
 #include "utils/json.h"
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
+#include "utils/relfilenodemap.h"
 #include "utils/ruleutils.h"
 #include "utils/snapmgr.h"
 #include "utils/tuplesort.h"
@@ -55,10 +57,20 @@ static void ExplainOneQuery(Query *query, IntoClause *into, ExplainState *es,
 static void report_triggers(ResultRelInfo *rInfo, bool show_relname,
 				ExplainState *es);
 static double elapsed_time(instr_time *starttime);
+static void show_rel_buffer_usage(RelBufferUsage *usage, int nentries,
+					  ExplainState *es);
+static int	rel_buffer_usage_cmp(const void *a, const void *b);
+static void show_io_latency(const char *qlabel, const long *hist,
+				ExplainState *es);
+static void show_wal_usage(const WalUsage *usage, const char *qlabel,
+			   ExplainState *es);
 static void ExplainPreScanNode(PlanState *planstate, Bitmapset **rels_used);
-static void ExplainPreScanMemberNodes(List *plans, PlanState **planstates,
+static void ExplainPreScanMemberNodes(PlanState **planstates, int nplans,
 						  Bitmapset **rels_used);
 static void ExplainPreScanSubPlans(List *plans, Bitmapset **rels_used);
+static void FingerprintPlan(Plan *plan, List *rtable, StringInfo buf);
+static void FingerprintPlanList(List *plans, List *rtable, StringInfo buf);
+static void FingerprintScanRel(Scan *plan, List *rtable, StringInfo buf);
 static void ExplainNode(PlanState *planstate, List *ancestors,
 			const char *relationship, const char *plan_name,
 			ExplainState *es);
@@ -80,6 +92,7 @@ static void show_sort_keys(SortState *sortstate, List *ancestors,
 			   ExplainState *es);
 static void show_merge_append_keys(MergeAppendState *mstate, List *ancestors,
 					   ExplainState *es);
+static void show_removed_subplans(int nplans, int nsubnodes, ExplainState *es);
 static void show_agg_keys(AggState *astate, List *ancestors,
 			  ExplainState *es);
 static void show_grouping_sets(PlanState *planstate, Agg *agg,
@@ -97,11 +110,20 @@ static void show_sort_group_keys(PlanState *planstate, const char *qlabel,
 static void show_sortorder_options(StringInfo buf, Node *sortexpr,
 					   Oid sortOperator, Oid collation, bool nullsFirst);
 static void show_sort_info(SortState *sortstate, ExplainState *es);
+static void show_incremental_sort_keys(IncrementalSortState *sortstate,
+						   List *ancestors, ExplainState *es);
+static void show_incremental_sort_info(IncrementalSortState *sortstate,
+						   ExplainState *es);
 static void show_hash_info(HashState *hashstate, ExplainState *es);
+static void show_adaptive_join_info(NestLoopState *nlstate, ExplainState *es);
+static void show_hashagg_info(AggState *aggstate, ExplainState *es);
+static void show_memoize_info(MemoizeState *mstate, List *ancestors,
+				  ExplainState *es);
 static void show_tidbitmap_info(BitmapHeapScanState *planstate,
 					ExplainState *es);
 static void show_instrumentation_count(const char *qlabel, int which,
 						   PlanState *planstate, ExplainState *es);
+static void show_join_filter_count(ScanState *scanstate, ExplainState *es);
 static void show_foreignscan_info(ForeignScanState *fsstate, ExplainState *es);
 static const char *explain_get_index_name(Oid indexId);
 static void ExplainIndexScanDetails(Oid indexid, ScanDirection indexorderdir,
@@ -111,7 +133,7 @@ static void ExplainModifyTarget(ModifyTable *plan, ExplainState *es);
 static void ExplainTargetRel(Plan *plan, Index rti, ExplainState *es);
 static void show_modifytable_info(ModifyTableState *mtstate, List *ancestors,
 					  ExplainState *es);
-static void ExplainMemberNodes(List *plans, PlanState **planstates,
+static void ExplainMemberNodes(PlanState **planstates, int nplans,
 				   List *ancestors, ExplainState *es);
 static void ExplainSubPlans(List *plans, List *ancestors,
 				const char *relationship, ExplainState *es);
@@ -157,6 +179,8 @@ ExplainQuery(ExplainStmt *stmt, const char *queryString,
 			es->costs = defGetBoolean(opt);
 		else if (strcmp(opt->defname, "buffers") == 0)
 			es->buffers = defGetBoolean(opt);
+		else if (strcmp(opt->defname, "wal") == 0)
+			es->wal = defGetBoolean(opt);
 		else if (strcmp(opt->defname, "timing") == 0)
 		{
 			timing_set = true;
@@ -192,6 +216,11 @@ ExplainQuery(ExplainStmt *stmt, const char *queryString,
 				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
 				 errmsg("EXPLAIN option BUFFERS requires ANALYZE")));
 
+	if (es->wal && !es->analyze)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("EXPLAIN option WAL requires ANALYZE")));
+
 	/* if the timing was not set explicitly, set default value */
 	es->timing = (timing_set) ? es->timing : es->analyze;
 
@@ -344,7 +373,7 @@ ExplainOneQuery(Query *query, IntoClause *into, ExplainState *es,
 		INSTR_TIME_SET_CURRENT(planstart);
 
 		/* plan the query */
-		plan = pg_plan_query(query, 0, params);
+		plan = pg_plan_query(query, CURSOR_OPT_PARALLEL_OK, params);
 
 		INSTR_TIME_SET_CURRENT(planduration);
 		INSTR_TIME_SUBTRACT(planduration, planstart);
@@ -436,6 +465,10 @@ ExplainOnePlan(PlannedStmt *plannedstmt, IntoClause *into, ExplainState *es,
 	double		totaltime = 0;
 	int			eflags;
 	int			instrument_option = 0;
+	WalUsage	walusage_start = pgWalUsage;
+	bool		track_rel_bufusage = false;
+	RelBufferUsage *rel_bufusage = NULL;
+	int			rel_bufusage_count = 0;
 
 	if (es->analyze && es->timing)
 		instrument_option |= INSTRUMENT_TIMER;
@@ -444,6 +477,8 @@ ExplainOnePlan(PlannedStmt *plannedstmt, IntoClause *into, ExplainState *es,
 
 	if (es->buffers)
 		instrument_option |= INSTRUMENT_BUFFERS;
+	if (es->wal)
+		instrument_option |= INSTRUMENT_WAL;
 
 	/*
 	 * We always collect timing for the entire statement, even when node-level
@@ -481,6 +516,13 @@ ExplainOnePlan(PlannedStmt *plannedstmt, IntoClause *into, ExplainState *es,
 	if (into)
 		eflags |= GetIntoRelEFlags(into);
 
+	/*
+	 * Break down the buffer usage of the whole statement by relation, too.
+	 * This stops by itself if we error out.
+	 */
+	if (es->analyze && es->buffers && es->summary)
+		track_rel_bufusage = InstrStartRelBufferUsage();
+
 	/* call ExecutorStart to prepare the plan for execution */
 	ExecutorStart(queryDesc, eflags);
 
@@ -505,6 +547,9 @@ ExplainOnePlan(PlannedStmt *plannedstmt, IntoClause *into, ExplainState *es,
 		totaltime += elapsed_time(&starttime);
 	}
 
+	if (track_rel_bufusage)
+		rel_bufusage = InstrEndRelBufferUsage(&rel_bufusage_count);
+
 	ExplainOpenGroup("Query", NULL, true, es);
 
 	/* Create textual dump of plan tree */
@@ -525,6 +570,9 @@ ExplainOnePlan(PlannedStmt *plannedstmt, IntoClause *into, ExplainState *es,
 	if (es->analyze)
 		ExplainPrintTriggers(es, queryDesc);
 
+	if (track_rel_bufusage)
+		show_rel_buffer_usage(rel_bufusage, rel_bufusage_count, es);
+
 	/*
 	 * Close down the query and free resources.  Include time for this in the
 	 * total execution time (although it should be pretty minimal).
@@ -543,6 +591,16 @@ ExplainOnePlan(PlannedStmt *plannedstmt, IntoClause *into, ExplainState *es,
 
 	totaltime += elapsed_time(&starttime);
 
+	/* Show the WAL generated by the statement as a whole */
+	if (es->wal && es->summary)
+	{
+		WalUsage	walusage;
+
+		memset(&walusage, 0, sizeof(WalUsage));
+		WalUsageAccumDiff(&walusage, &pgWalUsage, &walusage_start);
+		show_wal_usage(&walusage, "Total WAL", es);
+	}
+
 	if (es->summary)
 	{
 		if (es->format == EXPLAIN_FORMAT_TEXT)
@@ -616,6 +674,162 @@ ExplainPrintTriggers(ExplainState *es, QueryDesc *queryDesc)
 	ExplainCloseGroup("Triggers", "Triggers", false, es);
 }
 
+/*
+ * ExplainPlanFingerprint -
+ *	  compute a hash of the shape of a plan
+ *
+ * Two plans get the same fingerprint if they consist of the same node types
+ * in the same arrangement, scanning the same relations through the same
+ * indexes, with the same join, aggregation and set-operation strategies.
+ * Costs, row estimates and expressions are ignored, so the fingerprint
+ * stays the same across re-planning as long as the planner picks the same
+ * plan shape.  It is meant for noticing that a query's plan has changed,
+ * not for telling arbitrary plans apart.
+ */
+uint32
+ExplainPlanFingerprint(PlannedStmt *plannedstmt)
+{
+	StringInfoData buf;
+	uint32		result;
+
+	initStringInfo(&buf);
+	FingerprintPlan(plannedstmt->planTree, plannedstmt->rtable, &buf);
+	FingerprintPlanList(plannedstmt->subplans, plannedstmt->rtable, &buf);
+	result = hash_any((unsigned char *) buf.data, buf.len);
+	pfree(buf.data);
+
+	return result;
+}
+
+/* Append a value to a fingerprint buffer */
+#define FingerprintValue(buf, val) \
+	do { \
+		uint32		v_ = (uint32) (val); \
+		appendBinaryStringInfo(buf, (char *) &v_, sizeof(v_)); \
+	} while (0)
+
+/*
+ * Append the shape of one plan node and its children to a fingerprint
+ * buffer.  A NULL plan is recorded too, so that the position of each child
+ * is part of the fingerprint.
+ */
+static void
+FingerprintPlan(Plan *plan, List *rtable, StringInfo buf)
+{
+	if (plan == NULL)
+	{
+		FingerprintValue(buf, T_Invalid);
+		return;
+	}
+
+	FingerprintValue(buf, nodeTag(plan));
+
+	switch (nodeTag(plan))
+	{
+		case T_SeqScan:
+		case T_SampleScan:
+		case T_BitmapHeapScan:
+		case T_TidScan:
+		case T_ForeignScan:
+		case T_CustomScan:
+			FingerprintScanRel((Scan *) plan, rtable, buf);
+			break;
+		case T_IndexScan:
+			FingerprintScanRel((Scan *) plan, rtable, buf);
+			FingerprintValue(buf, ((IndexScan *) plan)->indexid);
+			FingerprintValue(buf, ((IndexScan *) plan)->indexorderdir);
+			break;
+		case T_IndexOnlyScan:
+			FingerprintScanRel((Scan *) plan, rtable, buf);
+			FingerprintValue(buf, ((IndexOnlyScan *) plan)->indexid);
+			FingerprintValue(buf, ((IndexOnlyScan *) plan)->indexorderdir);
+			break;
+		case T_BitmapIndexScan:
+			FingerprintValue(buf, ((BitmapIndexScan *) plan)->indexid);
+			break;
+		case T_NestLoop:
+		case T_MergeJoin:
+		case T_HashJoin:
+			FingerprintValue(buf, ((Join *) plan)->jointype);
+			break;
+		case T_Agg:
+			FingerprintValue(buf, ((Agg *) plan)->aggstrategy);
+			break;
+		case T_SetOp:
+			FingerprintValue(buf, ((SetOp *) plan)->cmd);
+			FingerprintValue(buf, ((SetOp *) plan)->strategy);
+			break;
+		case T_ModifyTable:
+			FingerprintValue(buf, ((ModifyTable *) plan)->operation);
+			break;
+		default:
+			break;
+	}
+
+	FingerprintPlan(plan->lefttree, rtable, buf);
+	FingerprintPlan(plan->righttree, rtable, buf);
+
+	/* special child plans */
+	switch (nodeTag(plan))
+	{
+		case T_ModifyTable:
+			FingerprintPlanList(((ModifyTable *) plan)->plans, rtable, buf);
+			break;
+		case T_Append:
+			FingerprintPlanList(((Append *) plan)->appendplans, rtable, buf);
+			break;
+		case T_MergeAppend:
+			FingerprintPlanList(((MergeAppend *) plan)->mergeplans,
+								rtable, buf);
+			break;
+		case T_BitmapAnd:
+			FingerprintPlanList(((BitmapAnd *) plan)->bitmapplans,
+								rtable, buf);
+			break;
+		case T_BitmapOr:
+			FingerprintPlanList(((BitmapOr *) plan)->bitmapplans,
+								rtable, buf);
+			break;
+		case T_SubqueryScan:
+			FingerprintPlan(((SubqueryScan *) plan)->subplan, rtable, buf);
+			break;
+		default:
+			break;
+	}
+}
+
+/*
+ * Append the shapes of a list of plans, preceded by the list length
+ */
+static void
+FingerprintPlanList(List *plans, List *rtable, StringInfo buf)
+{
+	ListCell   *lc;
+
+	FingerprintValue(buf, list_length(plans));
+	foreach(lc, plans)
+		FingerprintPlan((Plan *) lfirst(lc), rtable, buf);
+}
+
+/*
+ * Append the OID of the table a scan node reads, or InvalidOid if it scans
+ * something else (a function, a subquery, a join pushed down, ...)
+ */
+static void
+FingerprintScanRel(Scan *plan, List *rtable, StringInfo buf)
+{
+	Oid			relid = InvalidOid;
+
+	if (plan->scanrelid > 0)
+	{
+		RangeTblEntry *rte = rt_fetch(plan->scanrelid, rtable);
+
+		if (rte->rtekind == RTE_RELATION)
+			relid = rte->relid;
+	}
+	FingerprintValue(buf, relid);
+}
+
 /*
  * ExplainQueryText -
  *	  add a "Query Text" node that contains the actual text of the query
@@ -711,6 +925,182 @@ elapsed_time(instr_time *starttime)
 	return INSTR_TIME_GET_DOUBLE(endtime);
 }
 
+/*
+ * Show the buffer usage of a statement broken down by relation fork,
+ * busiest first.
+ */
+static void
+show_rel_buffer_usage(RelBufferUsage *usage, int nentries, ExplainState *es)
+{
+	int			i;
+
+	if (nentries == 0)
+		return;
+
+	qsort(usage, nentries, sizeof(RelBufferUsage), rel_buffer_usage_cmp);
+
+	if (es->format == EXPLAIN_FORMAT_TEXT)
+	{
+		appendStringInfoString(es->str, "Buffers by Relation:\n");
+		es->indent++;
+	}
+	ExplainOpenGroup("Relation Buffers", "Relation Buffers", false, es);
+
+	for (i = 0; i < nentries; i++)
+	{
+		RelBufferUsage *entry = &usage[i];
+		Oid			relid;
+		char	   *relname = NULL;
+		char	   *nspname = NULL;
+
+		relid = RelidByRelfilenode(entry->rnode.spcNode, entry->rnode.relNode);
+		if (OidIsValid(relid))
+		{
+			relname = get_rel_name(relid);
+			if (es->verbose && relname)
+				nspname = get_namespace_name(get_rel_namespace(relid));
+		}
+
+		if (es->format == EXPLAIN_FORMAT_TEXT)
+		{
+			appendStringInfoSpaces(es->str, es->indent * 2);
+			if (nspname)
+				appendStringInfo(es->str, "%s.", quote_identifier(nspname));
+			if (relname)
+				appendStringInfoString(es->str, quote_identifier(relname));
+			else
+				appendStringInfo(es->str, "relfilenode %u",
+								 entry->rnode.relNode);
+			if (entry->forknum != MAIN_FORKNUM)
+				appendStringInfo(es->str, " (%s)", forkNames[entry->forknum]);
+			appendStringInfoChar(es->str, ':');
+			if (entry->blks_hit > 0)
+				appendStringInfo(es->str, " hit=%ld", entry->blks_hit);
+			if (entry->blks_read > 0)
+				appendStringInfo(es->str, " read=%ld", entry->blks_read);
+			if (!INSTR_TIME_IS_ZERO(entry->blk_read_time))
+				appendStringInfo(es->str, " read time=%0.3f",
+							   INSTR_TIME_GET_MILLISEC(entry->blk_read_time));
+			appendStringInfoChar(es->str, '\n');
+		}
+		else
+		{
+			ExplainOpenGroup("Relation", NULL, true, es);
+			if (relname)
+				ExplainPropertyText("Relation Name", relname, es);
+			else
+				ExplainPropertyInteger("Relation Filenode",
+									   (int) entry->rnode.relNode, es);
+			if (nspname)
+				ExplainPropertyText("Schema", nspname, es);
+			ExplainPropertyText("Fork", forkNames[entry->forknum], es);
+			ExplainPropertyLong("Hit Blocks", entry->blks_hit, es);
+			ExplainPropertyLong("Read Blocks", entry->blks_read, es);
+			ExplainPropertyFloat("I/O Read Time",
+							  INSTR_TIME_GET_MILLISEC(entry->blk_read_time),
+								 3, es);
+			ExplainCloseGroup("Relation", NULL, true, es);
+		}
+	}
+
+	ExplainCloseGroup("Relation Buffers", "Relation Buffers", false, es);
+	if (es->format == EXPLAIN_FORMAT_TEXT)
+		es->indent--;
+}
+
+/* qsort comparator: most blocks read first, then most hits */
+static int
+rel_buffer_usage_cmp(const void *a, const void *b)
+{
+	const RelBufferUsage *ua = (const RelBufferUsage *) a;
+	const RelBufferUsage *ub = (const RelBufferUsage *) b;
+
+	if (ua->blks_read != ub->blks_read)
+		return (ua->blks_read > ub->blks_read) ? -1 : 1;
+	if (ua->blks_hit != ub->blks_hit)
+		return (ua->blks_hit > ub->blks_hit) ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Show an I/O latency histogram.  In text format, only the non-empty
+ * buckets are shown; otherwise the counts of all buckets are shown as a
+ * list, shortest latencies first.
+ */
+static void
+show_io_latency(const char *qlabel, const long *hist, ExplainState *es)
+{
+	int			i;
+
+	if (es->format == EXPLAIN_FORMAT_TEXT)
+	{
+		bool		any = false;
+
+		for (i = 0; i < IO_LATENCY_BUCKETS; i++)
+		{
+			if (hist[i] == 0)
+				continue;
+			if (!any)
+			{
+				appendStringInfoSpaces(es->str, es->indent * 2);
+				appendStringInfo(es->str, "%s:", qlabel);
+				any = true;
+			}
+			appendStringInfo(es->str, " %s=%ld",
+							 InstrIOLatencyBucketName(i), hist[i]);
+		}
+		if (any)
+			appendStringInfoChar(es->str, '\n');
+	}
+	else
+	{
+		List	   *data = NIL;
+
+		for (i = 0; i < IO_LATENCY_BUCKETS; i++)
+			data = lappend(data, psprintf("%ld", hist[i]));
+		ExplainPropertyList(qlabel, data, es);
+	}
+}
+
+/*
+ * Show WAL usage, of a plan node or of the whole statement.
+ */
+static void
+show_wal_usage(const WalUsage *usage, const char *qlabel, ExplainState *es)
+{
+	if (es->format == EXPLAIN_FORMAT_TEXT)
+	{
+		/* Show only positive counter values. */
+		if (usage->wal_records > 0 || usage->wal_fpi > 0 ||
+			usage->wal_bytes > 0)
+		{
+			appendStringInfoSpaces(es->str, es->indent * 2);
+			appendStringInfo(es->str, "%s:", qlabel);
+			if (usage->wal_records > 0)
+				appendStringInfo(es->str, " records=%ld", usage->wal_records);
+			if (usage->wal_fpi > 0)
+				appendStringInfo(es->str, " fpi=%ld", usage->wal_fpi);
+			if (usage->wal_bytes > 0)
+				appendStringInfo(es->str, " bytes=" UINT64_FORMAT,
+								 usage->wal_bytes);
+			appendStringInfoChar(es->str, '\n');
+		}
+	}
+	else
+	{
+		char		buf[32];
+		char		label[64];
+
+		snprintf(label, sizeof(label), "%s Records", qlabel);
+		ExplainPropertyLong(label, usage->wal_records, es);
+		snprintf(label, sizeof(label), "%s FPI", qlabel);
+		ExplainPropertyLong(label, usage->wal_fpi, es);
+		snprintf(label, sizeof(label), "%s Bytes", qlabel);
+		snprintf(buf, sizeof(buf), UINT64_FORMAT, usage->wal_bytes);
+		ExplainProperty(label, buf, true, es);
+	}
+}
+
 /*
  * ExplainPreScanNode -
  *	  Prescan the planstate tree to identify which RTEs are referenced
@@ -776,28 +1166,28 @@ ExplainPreScanNode(PlanState *planstate, Bitmapset **rels_used)
 	switch (nodeTag(plan))
 	{
 		case T_ModifyTable:
-			ExplainPreScanMemberNodes(((ModifyTable *) plan)->plans,
-								  ((ModifyTableState *) planstate)->mt_plans,
+			ExplainPreScanMemberNodes(((ModifyTableState *) planstate)->mt_plans,
+									  ((ModifyTableState *) planstate)->mt_nplans,
 									  rels_used);
 			break;
 		case T_Append:
-			ExplainPreScanMemberNodes(((Append *) plan)->appendplans,
-									((AppendState *) planstate)->appendplans,
+			ExplainPreScanMemberNodes(((AppendState *) planstate)->appendplans,
+									  ((AppendState *) planstate)->as_nplans,
 									  rels_used);
 			break;
 		case T_MergeAppend:
-			ExplainPreScanMemberNodes(((MergeAppend *) plan)->mergeplans,
-								((MergeAppendState *) planstate)->mergeplans,
+			ExplainPreScanMemberNodes(((MergeAppendState *) planstate)->mergeplans,
+									  ((MergeAppendState *) planstate)->ms_nplans,
 									  rels_used);
 			break;
 		case T_BitmapAnd:
-			ExplainPreScanMemberNodes(((BitmapAnd *) plan)->bitmapplans,
-								 ((BitmapAndState *) planstate)->bitmapplans,
+			ExplainPreScanMemberNodes(((BitmapAndState *) planstate)->bitmapplans,
+									  ((BitmapAndState *) planstate)->nplans,
 									  rels_used);
 			break;
 		case T_BitmapOr:
-			ExplainPreScanMemberNodes(((BitmapOr *) plan)->bitmapplans,
-								  ((BitmapOrState *) planstate)->bitmapplans,
+			ExplainPreScanMemberNodes(((BitmapOrState *) planstate)->bitmapplans,
+									  ((BitmapOrState *) planstate)->nplans,
 									  rels_used);
 			break;
 		case T_SubqueryScan:
@@ -817,14 +1207,13 @@ ExplainPreScanNode(PlanState *planstate, Bitmapset **rels_used)
  * Prescan the constituent plans of a ModifyTable, Append, MergeAppend,
  * BitmapAnd, or BitmapOr node.
  *
- * Note: we don't actually need to examine the Plan list members, but
- * we need the list in order to determine the length of the PlanState array.
+ * The PlanState array can be shorter than the node's Plan list, if
+ * ExecPruneSubplans left some subplans out.
  */
 static void
-ExplainPreScanMemberNodes(List *plans, PlanState **planstates,
+ExplainPreScanMemberNodes(PlanState **planstates, int nplans,
 						  Bitmapset **rels_used)
 {
-	int			nplans = list_length(plans);
 	int			j;
 
 	for (j = 0; j < nplans; j++)
@@ -876,6 +1265,7 @@ ExplainNode(PlanState *planstate, List *ancestors,
 	const char *pname;			/* node type name for text output */
 	const char *sname;			/* node type name for non-text output */
 	const char *strategy = NULL;
+	const char *partialmode = NULL;
 	const char *operation = NULL;
 	const char *custom_name = NULL;
 	int			save_indent = es->indent;
@@ -964,7 +1354,24 @@ ExplainNode(PlanState *planstate, List *ancestors,
 			pname = sname = "WorkTable Scan";
 			break;
 		case T_ForeignScan:
-			pname = sname = "Foreign Scan";
+			sname = "Foreign Scan";
+			switch (((ForeignScan *) plan)->operation)
+			{
+				case CMD_SELECT:
+					pname = "Foreign Scan";
+					break;
+				case CMD_UPDATE:
+					pname = "Foreign Update";
+					operation = "Update";
+					break;
+				case CMD_DELETE:
+					pname = "Foreign Delete";
+					operation = "Delete";
+					break;
+				default:
+					pname = "???";
+					break;
+			}
 			break;
 		case T_CustomScan:
 			sname = "Custom Scan";
@@ -994,9 +1401,15 @@ ExplainNode(PlanState *planstate, List *ancestors,
 		case T_Material:
 			pname = sname = "Materialize";
 			break;
+		case T_Memoize:
+			pname = sname = "Memoize";
+			break;
 		case T_Sort:
 			pname = sname = "Sort";
 			break;
+		case T_IncrementalSort:
+			pname = sname = "Incremental Sort";
+			break;
 		case T_Group:
 			pname = sname = "Group";
 			break;
@@ -1021,6 +1434,10 @@ ExplainNode(PlanState *planstate, List *ancestors,
 					strategy = "???";
 					break;
 			}
+			if (!((Agg *) plan)->finalizeAggs)
+				partialmode = "Partial";
+			else if (((Agg *) plan)->combineStates)
+				partialmode = "Finalize";
 			break;
 		case T_WindowAgg:
 			pname = sname = "WindowAgg";
@@ -1028,6 +1445,9 @@ ExplainNode(PlanState *planstate, List *ancestors,
 		case T_Unique:
 			pname = sname = "Unique";
 			break;
+		case T_Gather:
+			pname = sname = "Gather";
+			break;
 		case T_SetOp:
 			sname = "SetOp";
 			switch (((SetOp *) plan)->strategy)
@@ -1078,14 +1498,22 @@ ExplainNode(PlanState *planstate, List *ancestors,
 			appendStringInfoString(es->str, "->  ");
 			es->indent += 2;
 		}
+		if (plan->parallel_aware)
+			appendStringInfoString(es->str, "Parallel ");
+		if (partialmode)
+			appendStringInfo(es->str, "%s ", partialmode);
 		appendStringInfoString(es->str, pname);
 		es->indent++;
 	}
 	else
 	{
 		ExplainPropertyText("Node Type", sname, es);
+		if (plan->parallel_aware)
+			ExplainPropertyText("Parallel Aware", "true", es);
 		if (strategy)
 			ExplainPropertyText("Strategy", strategy, es);
+		if (partialmode)
+			ExplainPropertyText("Partial Mode", partialmode, es);
 		if (operation)
 			ExplainPropertyText("Operation", operation, es);
 		if (relationship)
@@ -1358,6 +1786,7 @@ ExplainNode(PlanState *planstate, List *ancestors,
 			if (plan->qual)
 				show_instrumentation_count("Rows Removed by Filter", 1,
 										   planstate, es);
+			show_join_filter_count((ScanState *) planstate, es);
 			if (es->analyze)
 				show_tidbitmap_info((BitmapHeapScanState *) planstate, es);
 			break;
@@ -1371,6 +1800,11 @@ ExplainNode(PlanState *planstate, List *ancestors,
 			if (plan->qual)
 				show_instrumentation_count("Rows Removed by Filter", 1,
 										   planstate, es);
+			show_join_filter_count((ScanState *) planstate, es);
+			break;
+		case T_Gather:
+			ExplainPropertyInteger("Number of Workers",
+								   ((Gather *) plan)->num_workers, es);
 			break;
 		case T_FunctionScan:
 			if (es->verbose)
@@ -1416,6 +1850,7 @@ ExplainNode(PlanState *planstate, List *ancestors,
 			if (plan->qual)
 				show_instrumentation_count("Rows Removed by Filter", 1,
 										   planstate, es);
+			show_join_filter_count((ScanState *) planstate, es);
 			show_foreignscan_info((ForeignScanState *) planstate, es);
 			break;
 		case T_CustomScan:
@@ -1440,6 +1875,7 @@ ExplainNode(PlanState *planstate, List *ancestors,
 			if (plan->qual)
 				show_instrumentation_count("Rows Removed by Filter", 2,
 										   planstate, es);
+			show_adaptive_join_info((NestLoopState *) planstate, es);
 			break;
 		case T_MergeJoin:
 			show_upper_qual(((MergeJoin *) plan)->mergeclauses,
@@ -1473,6 +1909,7 @@ ExplainNode(PlanState *planstate, List *ancestors,
 			if (plan->qual)
 				show_instrumentation_count("Rows Removed by Filter", 1,
 										   planstate, es);
+			show_hashagg_info((AggState *) planstate, es);
 			break;
 		case T_Group:
 			show_group_keys((GroupState *) planstate, ancestors, es);
@@ -1485,9 +1922,26 @@ ExplainNode(PlanState *planstate, List *ancestors,
 			show_sort_keys((SortState *) planstate, ancestors, es);
 			show_sort_info((SortState *) planstate, es);
 			break;
+		case T_IncrementalSort:
+			show_incremental_sort_keys((IncrementalSortState *) planstate,
+									   ancestors, es);
+			show_incremental_sort_info((IncrementalSortState *) planstate,
+									   es);
+			break;
+		case T_Memoize:
+			show_memoize_info((MemoizeState *) planstate, ancestors, es);
+			break;
+		case T_Append:
+			show_removed_subplans(list_length(((Append *) plan)->appendplans),
+								  ((AppendState *) planstate)->as_nplans,
+								  es);
+			break;
 		case T_MergeAppend:
 			show_merge_append_keys((MergeAppendState *) planstate,
 								   ancestors, es);
+			show_removed_subplans(list_length(((MergeAppend *) plan)->mergeplans),
+								  ((MergeAppendState *) planstate)->ms_nplans,
+								  es);
 			break;
 		case T_Result:
 			show_upper_qual((List *) ((Result *) plan)->resconstantqual,
@@ -1527,6 +1981,8 @@ ExplainNode(PlanState *planstate, List *ancestors,
 									usage->temp_blks_written > 0);
 			bool		has_timing = (!INSTR_TIME_IS_ZERO(usage->blk_read_time) ||
 								 !INSTR_TIME_IS_ZERO(usage->blk_write_time));
+			bool		has_temp_timing = (!INSTR_TIME_IS_ZERO(usage->temp_blk_read_time) ||
+							!INSTR_TIME_IS_ZERO(usage->temp_blk_write_time));
 
 			/* Show only positive counter values. */
 			if (has_shared || has_local || has_temp)
@@ -1584,7 +2040,7 @@ ExplainNode(PlanState *planstate, List *ancestors,
 			}
 
 			/* As above, show only positive counter values. */
-			if (has_timing)
+			if (has_timing || has_temp_timing)
 			{
 				appendStringInfoSpaces(es->str, es->indent * 2);
 				appendStringInfoString(es->str, "I/O Timings:");
@@ -1594,8 +2050,22 @@ ExplainNode(PlanState *planstate, List *ancestors,
 				if (!INSTR_TIME_IS_ZERO(usage->blk_write_time))
 					appendStringInfo(es->str, " write=%0.3f",
 							 INSTR_TIME_GET_MILLISEC(usage->blk_write_time));
+				if (has_timing && has_temp_timing)
+					appendStringInfoChar(es->str, ',');
+				if (has_temp_timing)
+				{
+					appendStringInfoString(es->str, " temp");
+					if (!INSTR_TIME_IS_ZERO(usage->temp_blk_read_time))
+						appendStringInfo(es->str, " read=%0.3f",
+						INSTR_TIME_GET_MILLISEC(usage->temp_blk_read_time));
+					if (!INSTR_TIME_IS_ZERO(usage->temp_blk_write_time))
+						appendStringInfo(es->str, " write=%0.3f",
+						INSTR_TIME_GET_MILLISEC(usage->temp_blk_write_time));
+				}
 				appendStringInfoChar(es->str, '\n');
 			}
+			show_io_latency("I/O Read Latency", usage->blk_read_hist, es);
+			show_io_latency("I/O Write Latency", usage->blk_write_hist, es);
 		}
 		else
 		{
@@ -1611,9 +2081,17 @@ ExplainNode(PlanState *planstate, List *ancestors,
 			ExplainPropertyLong("Temp Written Blocks", usage->temp_blks_written, es);
 			ExplainPropertyFloat("I/O Read Time", INSTR_TIME_GET_MILLISEC(usage->blk_read_time), 3, es);
 			ExplainPropertyFloat("I/O Write Time", INSTR_TIME_GET_MILLISEC(usage->blk_write_time), 3, es);
+			ExplainPropertyFloat("Temp I/O Read Time", INSTR_TIME_GET_MILLISEC(usage->temp_blk_read_time), 3, es);
+			ExplainPropertyFloat("Temp I/O Write Time", INSTR_TIME_GET_MILLISEC(usage->temp_blk_write_time), 3, es);
+			show_io_latency("I/O Read Latency", usage->blk_read_hist, es);
+			show_io_latency("I/O Write Latency", usage->blk_write_hist, es);
 		}
 	}
 
+	/* Show WAL usage */
+	if (es->wal && planstate->instrument)
+		show_wal_usage(&planstate->instrument->walusage, "WAL", es);
+
 	/* Get ready to display the child plans */
 	haschildren = planstate->initPlan ||
 		outerPlanState(planstate) ||
@@ -1650,28 +2128,28 @@ ExplainNode(PlanState *planstate, List *ancestors,
 	switch (nodeTag(plan))
 	{
 		case T_ModifyTable:
-			ExplainMemberNodes(((ModifyTable *) plan)->plans,
-							   ((ModifyTableState *) planstate)->mt_plans,
+			ExplainMemberNodes(((ModifyTableState *) planstate)->mt_plans,
+							   ((ModifyTableState *) planstate)->mt_nplans,
 							   ancestors, es);
 			break;
 		case T_Append:
-			ExplainMemberNodes(((Append *) plan)->appendplans,
-							   ((AppendState *) planstate)->appendplans,
+			ExplainMemberNodes(((AppendState *) planstate)->appendplans,
+							   ((AppendState *) planstate)->as_nplans,
 							   ancestors, es);
 			break;
 		case T_MergeAppend:
-			ExplainMemberNodes(((MergeAppend *) plan)->mergeplans,
-							   ((MergeAppendState *) planstate)->mergeplans,
+			ExplainMemberNodes(((MergeAppendState *) planstate)->mergeplans,
+							   ((MergeAppendState *) planstate)->ms_nplans,
 							   ancestors, es);
 			break;
 		case T_BitmapAnd:
-			ExplainMemberNodes(((BitmapAnd *) plan)->bitmapplans,
-							   ((BitmapAndState *) planstate)->bitmapplans,
+			ExplainMemberNodes(((BitmapAndState *) planstate)->bitmapplans,
+							   ((BitmapAndState *) planstate)->nplans,
 							   ancestors, es);
 			break;
 		case T_BitmapOr:
-			ExplainMemberNodes(((BitmapOr *) plan)->bitmapplans,
-							   ((BitmapOrState *) planstate)->bitmapplans,
+			ExplainMemberNodes(((BitmapOrState *) planstate)->bitmapplans,
+							   ((BitmapOrState *) planstate)->nplans,
 							   ancestors, es);
 			break;
 		case T_SubqueryScan:
@@ -1725,6 +2203,10 @@ show_plan_tlist(PlanState *planstate, List *ancestors, ExplainState *es)
 		return;
 	if (IsA(plan, RecursiveUnion))
 		return;
+	/* Likewise for a ForeignScan that does a direct UPDATE or DELETE */
+	if (IsA(plan, ForeignScan) &&
+		((ForeignScan *) plan)->operation != CMD_SELECT)
+		return;
 
 	/* Set up deparsing context */
 	context = set_deparse_context_planstate(es->deparse_cxt,
@@ -1849,6 +2331,38 @@ show_merge_append_keys(MergeAppendState *mstate, List *ancestors,
 						 ancestors, es);
 }
 
+/*
+ * Show how many subplans of an Append or MergeAppend node were left out by
+ * ExecPruneSubplans.
+ */
+static void
+show_removed_subplans(int nplans, int nsubnodes, ExplainState *es)
+{
+	if (nsubnodes < nplans)
+		ExplainPropertyInteger("Subplans Removed", nplans - nsubnodes, es);
+}
+
+/*
+ * Show the sort keys for an IncrementalSort node, and which of them the
+ * input is already sorted by.
+ */
+static void
+show_incremental_sort_keys(IncrementalSortState *sortstate,
+						   List *ancestors, ExplainState *es)
+{
+	IncrementalSort *plan = (IncrementalSort *) sortstate->ss.ps.plan;
+
+	show_sort_group_keys((PlanState *) sortstate, "Sort Key",
+						 plan->sort.numCols, plan->sort.sortColIdx,
+						 plan->sort.sortOperators, plan->sort.collations,
+						 plan->sort.nullsFirst,
+						 ancestors, es);
+	show_sort_group_keys((PlanState *) sortstate, "Presorted Key",
+						 plan->presortedCols, plan->sort.sortColIdx,
+						 NULL, NULL, NULL,
+						 ancestors, es);
+}
+
 /*
  * Show the grouping keys for an Agg node.
  */
@@ -2133,6 +2647,57 @@ show_sort_info(SortState *sortstate, ExplainState *es)
 	}
 }
 
+/*
+ * If it's EXPLAIN ANALYZE, show how many batches an incremental sort node
+ * sorted, and the tuplesort stats of the largest one
+ */
+static void
+show_incremental_sort_info(IncrementalSortState *sortstate, ExplainState *es)
+{
+	const char *sortMethod = sortstate->maxSortMethod;
+	const char *spaceType = sortstate->maxSpaceType;
+	long		spaceUsed = sortstate->maxSpaceUsed;
+
+	if (!es->analyze)
+		return;
+
+	/* Under a LIMIT, the last batch may not have been finished yet */
+	if (sortstate->tuplesortstate != NULL)
+	{
+		Tuplesortstate *state = (Tuplesortstate *) sortstate->tuplesortstate;
+		const char *curMethod;
+		const char *curType;
+		long		curUsed;
+
+		tuplesort_get_stats(state, &curMethod, &curType, &curUsed);
+		if (sortMethod == NULL || curUsed > spaceUsed)
+		{
+			sortMethod = curMethod;
+			spaceType = curType;
+			spaceUsed = curUsed;
+		}
+	}
+
+	if (sortMethod == NULL)
+		return;
+
+	if (es->format == EXPLAIN_FORMAT_TEXT)
+	{
+		appendStringInfoSpaces(es->str, es->indent * 2);
+		appendStringInfo(es->str,
+						 "Sort Batches: %ld  Sort Method: %s  Peak %s: %ldkB\n",
+						 sortstate->batchesSorted, sortMethod,
+						 spaceType, spaceUsed);
+	}
+	else
+	{
+		ExplainPropertyLong("Sort Batches", sortstate->batchesSorted, es);
+		ExplainPropertyText("Sort Method", sortMethod, es);
+		ExplainPropertyLong("Peak Sort Space Used", spaceUsed, es);
+		ExplainPropertyText("Sort Space Type", spaceType, es);
+	}
+}
+
 /*
  * Show information on hash buckets/batches.
  */
@@ -2181,6 +2746,114 @@ show_hash_info(HashState *hashstate, ExplainState *es)
 	}
 }
 
+/*
+ * If a nested loop switched to a hash join while running, show after how
+ * many outer rows it did, and the hash table it built.
+ */
+static void
+show_adaptive_join_info(NestLoopState *nlstate, ExplainState *es)
+{
+	if (!es->analyze || nlstate->nl_HashJoin == NULL)
+		return;
+
+	if (es->format != EXPLAIN_FORMAT_TEXT)
+		ExplainPropertyFloat("Switched to Hash Join After",
+							 nlstate->nl_SwitchedAfter, 0, es);
+	else
+	{
+		appendStringInfoSpaces(es->str, es->indent * 2);
+		appendStringInfo(es->str,
+						 "Switched to Hash Join after %.0f outer rows\n",
+						 nlstate->nl_SwitchedAfter);
+	}
+	show_hash_info((HashState *) innerPlanState(nlstate->nl_HashJoin), es);
+}
+
+/*
+ * If it's EXPLAIN ANALYZE, show how many passes a hashed aggregate made over
+ * its input and how much memory its hash table used.  In text format, only
+ * do so if it had to spill to disk.
+ */
+static void
+show_hashagg_info(AggState *aggstate, ExplainState *es)
+{
+	Agg		   *agg = (Agg *) aggstate->ss.ps.plan;
+	long		memPeakKb = (aggstate->hash_mem_peak + 1023) / 1024;
+
+	if (!es->analyze || agg->aggstrategy != AGG_HASHED ||
+		aggstate->hash_batches_used == 0)
+		return;
+
+	if (es->format != EXPLAIN_FORMAT_TEXT)
+	{
+		ExplainPropertyLong("Hash Batches", aggstate->hash_batches_used, es);
+		ExplainPropertyLong("Peak Memory Usage", memPeakKb, es);
+	}
+	else if (aggstate->hash_batches_used > 1)
+	{
+		appendStringInfoSpaces(es->str, es->indent * 2);
+		appendStringInfo(es->str, "Batches: %d  Memory Usage: %ldkB\n",
+						 aggstate->hash_batches_used, memPeakKb);
+	}
+}
+
+/*
+ * Show the cache key of a Memoize node, and if it's EXPLAIN ANALYZE, how
+ * well the cache worked.
+ */
+static void
+show_memoize_info(MemoizeState *mstate, List *ancestors, ExplainState *es)
+{
+	Memoize    *plan = (Memoize *) mstate->ss.ps.plan;
+	List	   *context;
+	StringInfoData keystr;
+	ListCell   *lc;
+	bool		useprefix;
+	long		memPeakKb;
+
+	/* Set up deparsing context */
+	context = set_deparse_context_planstate(es->deparse_cxt,
+											(Node *) mstate,
+											ancestors);
+	useprefix = list_length(es->rtable) > 1 || es->verbose;
+
+	initStringInfo(&keystr);
+	foreach(lc, plan->param_exprs)
+	{
+		Node	   *expr = (Node *) lfirst(lc);
+
+		if (keystr.len > 0)
+			appendStringInfoString(&keystr, ", ");
+		appendStringInfoString(&keystr,
+							   deparse_expression(expr, context,
+												  useprefix, false));
+	}
+	ExplainPropertyText("Cache Key", keystr.data, es);
+	pfree(keystr.data);
+
+	if (!es->analyze)
+		return;
+
+	memPeakKb = (mstate->mem_peak + 1023) / 1024;
+	if (es->format != EXPLAIN_FORMAT_TEXT)
+	{
+		ExplainPropertyLong("Cache Hits", mstate->cache_hits, es);
+		ExplainPropertyLong("Cache Misses", mstate->cache_misses, es);
+		ExplainPropertyLong("Cache Evictions", mstate->cache_evictions, es);
+		ExplainPropertyLong("Cache Overflows", mstate->cache_overflows, es);
+		ExplainPropertyLong("Peak Memory Usage", memPeakKb, es);
+	}
+	else if (mstate->cache_hits > 0 || mstate->cache_misses > 0)
+	{
+		appendStringInfoSpaces(es->str, es->indent * 2);
+		appendStringInfo(es->str,
+						 "Hits: %ld  Misses: %ld  Evictions: %ld  Overflows: %ld  Memory Usage: %ldkB\n",
+						 mstate->cache_hits, mstate->cache_misses,
+						 mstate->cache_evictions, mstate->cache_overflows,
+						 memPeakKb);
+	}
+}
+
 /*
  * If it's EXPLAIN ANALYZE, show exact/lossy pages for a BitmapHeapScan node
  */
@@ -2238,6 +2911,32 @@ show_instrumentation_count(const char *qlabel, int which,
 	}
 }
 
+/*
+ * If a hash join above pushed a Bloom filter down into this scan node, show
+ * how many rows it removed, like show_instrumentation_count.
+ */
+static void
+show_join_filter_count(ScanState *scanstate, ExplainState *es)
+{
+	JoinFilterState *jfstate = scanstate->ss_JoinFilter;
+	double		nloops;
+
+	if (!es->analyze || !scanstate->ps.instrument || jfstate == NULL)
+		return;
+
+	nloops = scanstate->ps.instrument->nloops;
+
+	/* In text mode, suppress zero counts; they're not interesting enough */
+	if (jfstate->nremoved_total > 0 || es->format != EXPLAIN_FORMAT_TEXT)
+	{
+		if (nloops > 0)
+			ExplainPropertyFloat("Rows Removed by Bloom Filter",
+								 jfstate->nremoved_total / nloops, 0, es);
+		else
+			ExplainPropertyFloat("Rows Removed by Bloom Filter", 0.0, 0, es);
+	}
+}
+
 /*
  * Show extra information for a ForeignScan node.
  */
@@ -2247,8 +2946,16 @@ show_foreignscan_info(ForeignScanState *fsstate, ExplainState *es)
 	FdwRoutine *fdwroutine = fsstate->fdwroutine;
 
 	/* Let the FDW emit whatever fields it wants */
-	if (fdwroutine->ExplainForeignScan != NULL)
-		fdwroutine->ExplainForeignScan(fsstate, es);
+	if (((ForeignScan *) fsstate->ss.ps.plan)->operation != CMD_SELECT)
+	{
+		if (fdwroutine->ExplainDirectModify != NULL)
+			fdwroutine->ExplainDirectModify(fsstate, es);
+	}
+	else
+	{
+		if (fdwroutine->ExplainForeignScan != NULL)
+			fdwroutine->ExplainForeignScan(fsstate, es);
+	}
 }
 
 /*
@@ -2527,8 +3234,9 @@ show_modifytable_info(ModifyTableState *mtstate, List *ancestors,
 			}
 		}
 
-		/* Give FDW a chance */
-		if (fdwroutine && fdwroutine->ExplainForeignModify != NULL)
+		/* Give FDW a chance, unless the subplan does the modification */
+		if (!resultRelInfo->ri_usesFdwDirectModify &&
+			fdwroutine && fdwroutine->ExplainForeignModify != NULL)
 		{
 			List	   *fdw_private = (List *) list_nth(node->fdwPrivLists, j);
 
@@ -2610,14 +3318,13 @@ show_modifytable_info(ModifyTableState *mtstate, List *ancestors,
  * The ancestors list should already contain the immediate parent of these
  * plans.
  *
- * Note: we don't actually need to examine the Plan list members, but
- * we need the list in order to determine the length of the PlanState array.
+ * The PlanState array can be shorter than the node's Plan list, if
+ * ExecPruneSubplans left some subplans out.
  */
 static void
-ExplainMemberNodes(List *plans, PlanState **planstates,
+ExplainMemberNodes(PlanState **planstates, int nplans,
 				   List *ancestors, ExplainState *es)
 {
-	int			nplans = list_length(plans);
 	int			j;
 
 	for (j = 0; j < nplans; j++)
@@ -16,27 +16,46 @@
 
 #include "access/htup_details.h"
 #include "access/multixact.h"
+#include "access/sysattr.h"
 #include "access/xact.h"
 #include "access/xlog.h"
 #include "catalog/catalog.h"
+#include "catalog/dependency.h"
 #include "catalog/indexing.h"
 #include "catalog/namespace.h"
+#include "catalog/pg_aggregate.h"
+#include "catalog/pg_inherits_fn.h"
+#include "catalog/pg_namespace.h"
 #include "catalog/pg_operator.h"
+#include "catalog/pg_trigger.h"
+#include "catalog/pg_type.h"
 #include "commands/cluster.h"
 #include "commands/matview.h"
 #include "commands/tablecmds.h"
 #include "commands/tablespace.h"
+#include "commands/trigger.h"
 #include "executor/executor.h"
 #include "executor/spi.h"
 #include "miscadmin.h"
+#include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
+#include "optimizer/clauses.h"
+#include "parser/parse_coerce.h"
+#include "parser/parse_func.h"
 #include "parser/parse_relation.h"
+#include "parser/parser.h"
+#include "parser/parsetree.h"
 #include "rewrite/rewriteHandler.h"
 #include "storage/lmgr.h"
 #include "storage/smgr.h"
 #include "tcop/tcopprot.h"
+#include "utils/acl.h"
 #include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
+#include "utils/ruleutils.h"
 #include "utils/snapmgr.h"
 #include "utils/syscache.h"
 #include "utils/typcache.h"
@@ -653,7 +672,7 @@ refresh_by_match_merge(Oid matviewOid, Oid tempOid, Oid relowner,
 			RelationGetIndexExpressions(indexRel) == NIL &&
 			RelationGetIndexPredicate(indexRel) == NIL)
 		{
-			int			numatts = indexStruct->indnatts;
+			int			numatts = indexStruct->indnkeyatts;
 			int			i;
 
 			/* Add quals for all columns from this index. */
@@ -805,3 +824,1111 @@ CloseMatViewIncrementalMaintenance(void)
 	matview_maintenance_depth--;
 	Assert(matview_maintenance_depth >= 0);
 }
+
+
+/*
+ * Incremental maintenance
+ *
+ * CREATE INCREMENTAL MATERIALIZED VIEW puts internal AFTER triggers on the
+ * tables the view's query reads, which call matview_incremental_maintenance
+ * to apply each change of those tables to the view's contents.  This works
+ * for queries that inner-join plain tables, optionally grouping the result
+ * and computing count, sum and avg.
+ *
+ * For a changed row, we run the view's query with the changed table replaced
+ * by just that row, which gives the rows, or the groups, to add to or remove
+ * from the view.  The triggers are row triggers, and are named so that they
+ * fire before those of foreign keys: each row's change is thus computed
+ * against the other tables as they were before any changes that cascade from
+ * it.  An aggregate view gets hidden columns, with names starting with
+ * "__ivm_", holding the number of rows of each group and, for each sum and
+ * avg, the number of non-null inputs and for avg also their sum, so that the
+ * new aggregate values of a group can be computed from the old ones and the
+ * change.
+ *
+ * Maintenance takes ExclusiveLock on the view, so that writers to the view's
+ * tables are serialized until they commit, and runs its queries with the
+ * latest snapshot, so that each change is applied against the rows of all
+ * changes committed before it, whatever the isolation level.
+ */
+
+/* Prefix of the names of hidden columns */
+#define IVM_COLUMN_PREFIX	"__ivm_"
+/* Hidden column counting the rows of each group */
+#define IVM_COUNT_COLUMN	"__ivm_count__"
+
+/* Most columns rows of a view can be identified by */
+#define IVM_MAX_KEYS		64
+
+typedef enum IvmColumnKind
+{
+	IVM_COLUMN_KEY,				/* GROUP BY column, or any column of a view
+								 * without aggregates */
+	IVM_COLUMN_COUNT,			/* count, or a hidden count */
+	IVM_COLUMN_SUM,				/* sum, or the hidden sum of an avg */
+	IVM_COLUMN_AVG				/* avg */
+} IvmColumnKind;
+
+typedef struct IvmColumn
+{
+	IvmColumnKind kind;
+	AttrNumber	countcol;		/* SUM, AVG: column counting the inputs */
+	AttrNumber	sumcol;			/* AVG: column summing the inputs */
+} IvmColumn;
+
+typedef enum IvmPlanKind
+{
+	IVM_PLAN_DELTA,				/* view's query over a changed row */
+	IVM_PLAN_INSERT_DELTA,		/* add that to a view without aggregates */
+	IVM_PLAN_DELETE_ROW,		/* remove a row from such a view */
+	IVM_PLAN_ADD_GROUP,			/* add to the aggregates of a group */
+	IVM_PLAN_SUB_GROUP,			/* subtract from the aggregates of a group */
+	IVM_PLAN_DELETE_GROUP,		/* remove a group whose rows all went away */
+	IVM_PLAN_INSERT_GROUP,		/* add a new group */
+	IVM_PLAN_RECOMPUTE			/* recompute the view after TRUNCATE */
+} IvmPlanKind;
+
+typedef struct IvmPlanKey
+{
+	Oid			matviewid;		/* the view */
+	Oid			relid;			/* changed table, for the DELTA plans */
+	IvmPlanKind kind;
+	uint64		nullmask;		/* keys to match with IS NULL */
+} IvmPlanKey;
+
+typedef struct IvmPlanEntry
+{
+	IvmPlanKey	key;			/* hash key, must be first */
+	SPIPlanPtr	plan;
+} IvmPlanEntry;
+
+/* What we know about the view being maintained */
+typedef struct IvmState
+{
+	Relation	matviewRel;
+	Relation	baseRel;		/* table that changed */
+	Query	   *query;			/* the view's query */
+	Index		baserti;		/* baseRel's range table index in query */
+	int			nbaseargs;		/* highest column number of baseRel used */
+	bool		aggregate;		/* aggregates or GROUP BY? */
+	bool		grouped;		/* GROUP BY? */
+	int			ncolumns;
+	IvmColumn  *columns;		/* per column of the view */
+	Oid		   *coltypes;		/* per column of the view */
+	AttrNumber	countcol;		/* __ivm_count__, or 0 */
+	int			nkeys;
+	AttrNumber	keys[IVM_MAX_KEYS];		/* columns identifying a row */
+} IvmState;
+
+static HTAB *ivm_plan_cache = NULL;
+
+static void ivm_unsupported(const char *what);
+static Aggref *ivm_make_aggregate(Aggref *model, const char *aggname);
+static void ivm_create_trigger(Oid relid, const ObjectAddress *matview,
+				   bool row, int16 events, List *columns);
+static void ivm_init_state(IvmState *state, Relation matviewRel,
+			   Relation baseRel);
+static void ivm_apply_change(IvmState *state, HeapTuple tuple, bool insert);
+static SPIPlanPtr ivm_get_plan(IvmState *state, IvmPlanKind kind,
+			 uint64 nullmask);
+static void ivm_execute(SPIPlanPtr plan, Datum *values, char *nulls,
+			int expected);
+static char *ivm_delta_query(IvmState *state);
+static const char *ivm_column_name(IvmState *state, AttrNumber attno);
+static void ivm_append_keys(StringInfo buf, IvmState *state,
+				uint64 nullmask);
+static void ivm_append_set_list(StringInfo buf, IvmState *state, bool add);
+static void ivm_append_sum(StringInfo buf, IvmState *state,
+			   AttrNumber attno, bool add);
+
+static void
+ivm_unsupported(const char *what)
+{
+	ereport(ERROR,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("%s is not supported in incrementally maintained materialized views",
+					what)));
+}
+
+/*
+ * PrepareIncrementalMatViewQuery
+ *		Check the query of CREATE INCREMENTAL MATERIALIZED VIEW and add the
+ *		hidden columns maintenance needs.
+ *
+ * colNames are the column names given in the command.  The tables the query
+ * reads are locked against writes, so that the view's data and its triggers
+ * will be consistent; the caller must compute the data with a snapshot taken
+ * after this.  Returns a modified copy of the query.
+ */
+Query *
+PrepareIncrementalMatViewQuery(Query *query, List *colNames)
+{
+	List	   *relids = NIL;
+	List	   *hidden = NIL;
+	int			nkeys = 0;
+	int			ncolumns;
+	ListCell   *lc;
+
+	query = (Query *) copyObject(query);
+
+	if (query->cteList != NIL)
+		ivm_unsupported("WITH");
+	if (query->hasSubLinks)
+		ivm_unsupported("subquery");
+	if (query->hasWindowFuncs)
+		ivm_unsupported("window function");
+	if (query->setOperations != NULL)
+		ivm_unsupported("UNION/INTERSECT/EXCEPT");
+	if (query->distinctClause != NIL)
+		ivm_unsupported("DISTINCT");
+	if (query->limitCount != NULL || query->limitOffset != NULL)
+		ivm_unsupported("LIMIT/OFFSET");
+	if (query->havingQual != NULL)
+		ivm_unsupported("HAVING");
+	if (query->groupingSets != NIL)
+		ivm_unsupported("GROUPING SETS");
+	if (query->rowMarks != NIL)
+		ivm_unsupported("FOR UPDATE/SHARE");
+	if (contain_volatile_functions((Node *) query))
+		ivm_unsupported("volatile function");
+
+	foreach(lc, query->rtable)
+	{
+		RangeTblEntry *rte = (RangeTblEntry *) lfirst(lc);
+		Relation	rel;
+		AclResult	aclresult;
+		int			x;
+
+		if (rte->rtekind == RTE_JOIN)
+		{
+			if (rte->jointype != JOIN_INNER)
+				ivm_unsupported("outer join");
+			continue;
+		}
+		if (rte->rtekind != RTE_RELATION || rte->relkind != RELKIND_RELATION)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("incrementally maintained materialized views can only read plain tables")));
+		if (rte->tablesample != NULL)
+			ivm_unsupported("TABLESAMPLE");
+		if (list_member_oid(relids, rte->relid))
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("table \"%s\" is read more than once",
+							get_rel_name(rte->relid)),
+					 errdetail("Incrementally maintained materialized views can read each table only once.")));
+		relids = lappend_oid(relids, rte->relid);
+
+		/* The maintenance triggers get the rows one by one */
+		x = -1;
+		while ((x = bms_next_member(rte->selectedCols, x)) >= 0)
+		{
+			if (x + FirstLowInvalidHeapAttributeNumber <= 0)
+				ivm_unsupported("system column or whole-row reference");
+		}
+
+		/* Only those who may put triggers on the table get to maintain it */
+		aclresult = pg_class_aclcheck(rte->relid, GetUserId(), ACL_TRIGGER);
+		if (aclresult != ACLCHECK_OK)
+			aclcheck_error(aclresult, ACL_KIND_CLASS,
+						   get_rel_name(rte->relid));
+
+		rel = heap_open(rte->relid, ShareRowExclusiveLock);
+		if (rte->inh && has_subclass(rte->relid))
+			ivm_unsupported("table with inheritance children");
+		if (rel->rd_rel->relrowsecurity)
+			ivm_unsupported("table with row level security");
+		heap_close(rel, NoLock);
+	}
+
+	foreach(lc, query->targetList)
+	{
+		TargetEntry *tle = (TargetEntry *) lfirst(lc);
+
+		if (tle->resjunk)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("GROUP BY and ORDER BY expressions of incrementally maintained materialized views must appear in the select list")));
+		if (strncmp(tle->resname, IVM_COLUMN_PREFIX,
+					strlen(IVM_COLUMN_PREFIX)) == 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_RESERVED_NAME),
+					 errmsg("column name \"%s\" is reserved for incrementally maintained materialized views",
+							tle->resname)));
+		if (expression_returns_set((Node *) tle->expr))
+			ivm_unsupported("set-returning function");
+
+		if (IsA(tle->expr, Aggref))
+		{
+			Aggref	   *agg = (Aggref *) tle->expr;
+			char	   *aggname = get_func_name(agg->aggfnoid);
+
+			if (get_func_namespace(agg->aggfnoid) != PG_CATALOG_NAMESPACE ||
+				(strcmp(aggname, "count") != 0 &&
+				 strcmp(aggname, "sum") != 0 &&
+				 strcmp(aggname, "avg") != 0))
+				ereport(ERROR,
+						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						 errmsg("aggregate function %s is not supported in incrementally maintained materialized views",
+								format_procedure(agg->aggfnoid)),
+						 errhint("Only count, sum and avg are supported.")));
+			if (agg->aggdistinct != NIL || agg->aggorder != NIL ||
+				agg->aggfilter != NULL || agg->aggkind != AGGKIND_NORMAL)
+				ivm_unsupported("aggregate with DISTINCT, ORDER BY or FILTER");
+			if (strcmp(aggname, "avg") == 0)
+			{
+				Oid			argtype;
+
+				argtype = exprType((Node *) ((TargetEntry *) linitial(agg->args))->expr);
+				if (argtype != INT2OID && argtype != INT4OID &&
+					argtype != INT8OID && argtype != FLOAT4OID &&
+					argtype != FLOAT8OID && argtype != NUMERICOID)
+					ereport(ERROR,
+							(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							 errmsg("aggregate function %s is not supported in incrementally maintained materialized views",
+									format_procedure(agg->aggfnoid))));
+			}
+
+			/* The inputs of sum and avg are counted, those of avg summed */
+			if (strcmp(aggname, "count") != 0)
+				hidden = lappend(hidden,
+					  makeTargetEntry((Expr *) ivm_make_aggregate(agg, "count"),
+									  0,
+									  psprintf(IVM_COLUMN_PREFIX "count_%d__",
+											   tle->resno),
+									  false));
+			if (strcmp(aggname, "avg") == 0)
+				hidden = lappend(hidden,
+						makeTargetEntry((Expr *) ivm_make_aggregate(agg, "sum"),
+										0,
+										psprintf(IVM_COLUMN_PREFIX "sum_%d__",
+												 tle->resno),
+										false));
+			continue;
+		}
+
+		if (contain_agg_clause((Node *) tle->expr))
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("incrementally maintained materialized views can only use aggregate functions as whole columns")));
+
+		/* Rows, or groups, are identified by all other columns */
+		if (query->hasAggs || query->groupClause != NIL)
+		{
+			ListCell   *lc2;
+			bool		grouped = false;
+
+			foreach(lc2, query->groupClause)
+			{
+				SortGroupClause *sgc = (SortGroupClause *) lfirst(lc2);
+
+				if (tle->ressortgroupref != 0 &&
+					sgc->tleSortGroupRef == tle->ressortgroupref)
+					grouped = true;
+			}
+			if (!grouped)
+				ereport(ERROR,
+						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						 errmsg("columns of incrementally maintained materialized views with aggregates must be aggregates or GROUP BY expressions")));
+		}
+		if (!OidIsValid(lookup_type_cache(exprType((Node *) tle->expr),
+										  TYPECACHE_EQ_OPR)->eq_opr))
+			ereport(ERROR,
+					(errcode(ERRCODE_UNDEFINED_FUNCTION),
+					 errmsg("could not identify an equality operator for type %s",
+							format_type_be(exprType((Node *) tle->expr)))));
+		if (++nkeys > IVM_MAX_KEYS)
+			ereport(ERROR,
+					(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+					 errmsg("incrementally maintained materialized views can have at most %d non-aggregate columns",
+							IVM_MAX_KEYS)));
+	}
+
+	ncolumns = list_length(query->targetList);
+	if (list_length(colNames) > ncolumns)
+		ereport(ERROR,
+				(errcode(ERRCODE_SYNTAX_ERROR),
+				 errmsg("too many column names were specified")));
+	foreach(lc, colNames)
+	{
+		char	   *colname = strVal(lfirst(lc));
+
+		if (strncmp(colname, IVM_COLUMN_PREFIX, strlen(IVM_COLUMN_PREFIX)) == 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_RESERVED_NAME),
+					 errmsg("column name \"%s\" is reserved for incrementally maintained materialized views",
+							colname)));
+	}
+
+	/* Aggregate views count the rows of each group, ahead of the rest */
+	if (query->hasAggs || query->groupClause != NIL)
+	{
+		hidden = lcons(makeTargetEntry((Expr *) ivm_make_aggregate(NULL, "count"),
+									   0, pstrdup(IVM_COUNT_COLUMN), false),
+					   hidden);
+		foreach(lc, hidden)
+		{
+			TargetEntry *tle = (TargetEntry *) lfirst(lc);
+
+			tle->resno = ++ncolumns;
+			query->targetList = lappend(query->targetList, tle);
+		}
+		query->hasAggs = true;
+	}
+
+	return query;
+}
+
+/*
+ * Make a pg_catalog count or sum over the argument of aggregate model, or
+ * count(*) if model is NULL.  Float4 input is summed in float8, as avg does.
+ */
+static Aggref *
+ivm_make_aggregate(Aggref *model, const char *aggname)
+{
+	List	   *funcname = list_make2(makeString("pg_catalog"),
+									  makeString(pstrdup(aggname)));
+	Aggref	   *agg;
+	Oid			argtype;
+
+	if (model == NULL)
+	{
+		agg = makeNode(Aggref);
+		agg->aggfnoid = LookupFuncName(funcname, 0, NULL, false);
+		agg->aggtype = INT8OID;
+		agg->aggcollid = InvalidOid;
+		agg->inputcollid = InvalidOid;
+		agg->aggstar = true;
+		agg->aggkind = AGGKIND_NORMAL;
+		agg->location = -1;
+		return agg;
+	}
+
+	agg = (Aggref *) copyObject(model);
+	agg->aggstar = false;
+	agg->aggvariadic = false;
+	agg->aggcollid = InvalidOid;
+	if (strcmp(aggname, "count") == 0)
+	{
+		argtype = ANYOID;
+		agg->aggfnoid = LookupFuncName(funcname, 1, &argtype, false);
+		agg->aggtype = INT8OID;
+	}
+	else
+	{
+		TargetEntry *arg = (TargetEntry *) linitial(agg->args);
+
+		argtype = exprType((Node *) arg->expr);
+		if (argtype == FLOAT4OID)
+		{
+			arg->expr = (Expr *) coerce_to_target_type(NULL,
+													   (Node *) arg->expr,
+													   FLOAT4OID,
+													   FLOAT8OID, -1,
+													   COERCION_IMPLICIT,
+													   COERCE_IMPLICIT_CAST,
+													   -1);
+			argtype = FLOAT8OID;
+		}
+		agg->aggfnoid = LookupFuncName(funcname, 1, &argtype, false);
+		agg->aggtype = get_func_rettype(agg->aggfnoid);
+	}
+
+	return agg;
+}
+
+/*
+ * CreateIncrementalMatViewTriggers
+ *		Put the maintenance triggers of a new materialized view on the tables
+ *		its query reads.
+ *
+ * query is what PrepareIncrementalMatViewQuery returned.  Each table gets a
+ * row trigger for the inserts and deletes and for the updates of the columns
+ * the view uses, and a statement trigger that recomputes the view on
+ * TRUNCATE.  The triggers go away along with the view.
+ */
+void
+CreateIncrementalMatViewTriggers(Query *query, Oid matviewOid)
+{
+	ObjectAddress matview;
+	ListCell   *lc;
+
+	ObjectAddressSet(matview, RelationRelationId, matviewOid);
+
+	foreach(lc, query->rtable)
+	{
+		RangeTblEntry *rte = (RangeTblEntry *) lfirst(lc);
+		List	   *columns = NIL;
+		int16		events = TRIGGER_TYPE_INSERT | TRIGGER_TYPE_DELETE;
+		int			x;
+
+		if (rte->rtekind != RTE_RELATION)
+			continue;
+
+		x = -1;
+		while ((x = bms_next_member(rte->selectedCols, x)) >= 0)
+			columns = lappend(columns,
+							  makeString(get_relid_attribute_name(rte->relid,
+							   x + FirstLowInvalidHeapAttributeNumber)));
+		if (columns != NIL)
+			events |= TRIGGER_TYPE_UPDATE;
+
+		ivm_create_trigger(rte->relid, &matview, true, events, columns);
+		ivm_create_trigger(rte->relid, &matview, false,
+						   TRIGGER_TYPE_TRUNCATE, NIL);
+	}
+}
+
+static void
+ivm_create_trigger(Oid relid, const ObjectAddress *matview, bool row,
+				   int16 events, List *columns)
+{
+	CreateTrigStmt *trigger;
+	ObjectAddress address;
+
+	/*
+	 * Triggers fire in name order.  "IVM_trigger_NNNN" sorts before the
+	 * "RI_ConstraintTrigger_..." of foreign keys, so cascaded changes come
+	 * after the change they cascade from.
+	 */
+	trigger = makeNode(CreateTrigStmt);
+	trigger->trigname = "IVM_trigger";
+	trigger->relation = NULL;
+	trigger->funcname = SystemFuncName("matview_incremental_maintenance");
+	trigger->args = list_make1(makeString(psprintf("%u", matview->objectId)));
+	trigger->row = row;
+	trigger->timing = TRIGGER_TYPE_AFTER;
+	trigger->events = events;
+	trigger->columns = columns;
+	trigger->transitionRels = NIL;
+	trigger->whenClause = NULL;
+	trigger->isconstraint = false;
+	trigger->deferrable = false;
+	trigger->initdeferred = false;
+	trigger->constrrel = NULL;
+
+	address = CreateTrigger(trigger, NULL, relid, InvalidOid, InvalidOid,
+							InvalidOid, true);
+	recordDependencyOn(&address, matview, DEPENDENCY_AUTO);
+
+	/*
+	 * Make changes-so-far visible; the next trigger on the same table must
+	 * see the pg_class update this one made.
+	 */
+	CommandCounterIncrement();
+}
+
+/*
+ * matview_incremental_maintenance
+ *		Trigger function applying a change of a table to an incrementally
+ *		maintained materialized view, given by OID as the argument.
+ */
+Datum
+matview_incremental_maintenance(PG_FUNCTION_ARGS)
+{
+	TriggerData *trigdata = (TriggerData *) fcinfo->context;
+	Trigger    *trigger;
+	Oid			matviewOid;
+	Relation	matviewRel;
+	IvmState	state;
+	Oid			save_userid;
+	int			save_sec_context;
+	int			save_nestlevel;
+	int			old_depth = matview_maintenance_depth;
+
+	if (!CALLED_AS_TRIGGER(fcinfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_E_R_I_E_TRIGGER_PROTOCOL_VIOLATED),
+				 errmsg("function \"%s\" was not called by trigger manager",
+						"matview_incremental_maintenance")));
+	if (!TRIGGER_FIRED_AFTER(trigdata->tg_event))
+		ereport(ERROR,
+				(errcode(ERRCODE_E_R_I_E_TRIGGER_PROTOCOL_VIOLATED),
+				 errmsg("function \"%s\" must be fired AFTER",
+						"matview_incremental_maintenance")));
+
+	trigger = trigdata->tg_trigger;
+	if (trigger->tgnargs != 1)
+		elog(ERROR, "wrong number of arguments for trigger \"%s\"",
+			 trigger->tgname);
+	matviewOid = (Oid) strtoul(trigger->tgargs[0], NULL, 10);
+
+	/* Until REFRESH populates the view, there is nothing to maintain */
+	matviewRel = heap_open(matviewOid, ExclusiveLock);
+	if (!RelationIsPopulated(matviewRel))
+	{
+		heap_close(matviewRel, NoLock);
+		return PointerGetDatum(NULL);
+	}
+
+	/* Run as the view's owner, like REFRESH */
+	GetUserIdAndSecContext(&save_userid, &save_sec_context);
+	SetUserIdAndSecContext(matviewRel->rd_rel->relowner,
+						   save_sec_context | SECURITY_LOCAL_USERID_CHANGE |
+						   SECURITY_RESTRICTED_OPERATION);
+	save_nestlevel = NewGUCNestLevel();
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "SPI_connect failed");
+
+	ivm_init_state(&state, matviewRel, trigdata->tg_relation);
+
+	OpenMatViewIncrementalMaintenance();
+	PG_TRY();
+	{
+		if (TRIGGER_FIRED_BY_TRUNCATE(trigdata->tg_event))
+			ivm_execute(ivm_get_plan(&state, IVM_PLAN_RECOMPUTE, 0),
+						NULL, NULL, SPI_OK_INSERT);
+		else if (TRIGGER_FIRED_BY_INSERT(trigdata->tg_event))
+			ivm_apply_change(&state, trigdata->tg_trigtuple, true);
+		else
+		{
+			ivm_apply_change(&state, trigdata->tg_trigtuple, false);
+			if (TRIGGER_FIRED_BY_UPDATE(trigdata->tg_event))
+				ivm_apply_change(&state, trigdata->tg_newtuple, true);
+		}
+	}
+	PG_CATCH();
+	{
+		matview_maintenance_depth = old_depth;
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+	CloseMatViewIncrementalMaintenance();
+
+	if (SPI_finish() != SPI_OK_FINISH)
+		elog(ERROR, "SPI_finish failed");
+
+	/* Roll back any GUC changes */
+	AtEOXact_GUC(false, save_nestlevel);
+
+	/* Restore userid and security context */
+	SetUserIdAndSecContext(save_userid, save_sec_context);
+
+	heap_close(matviewRel, NoLock);
+
+	return PointerGetDatum(NULL);
+}
+
+/*
+ * Work out the roles of the view's columns from its query.
+ */
+static void
+ivm_init_state(IvmState *state, Relation matviewRel, Relation baseRel)
+{
+	TupleDesc	desc = RelationGetDescr(matviewRel);
+	RangeTblEntry *rte = NULL;
+	ListCell   *lc;
+	Index		rti;
+	int			x;
+	int			i;
+
+	memset(state, 0, sizeof(IvmState));
+	state->matviewRel = matviewRel;
+	state->baseRel = baseRel;
+	state->query = (Query *) copyObject(get_view_query(matviewRel));
+	state->grouped = (state->query->groupClause != NIL);
+	state->aggregate = (state->query->hasAggs || state->grouped);
+
+	rti = 0;
+	foreach(lc, state->query->rtable)
+	{
+		rti++;
+		rte = (RangeTblEntry *) lfirst(lc);
+		if (rte->rtekind == RTE_RELATION &&
+			rte->relid == RelationGetRelid(baseRel))
+			break;
+		rte = NULL;
+	}
+	if (rte == NULL)
+		elog(ERROR, "materialized view \"%s\" does not read table \"%s\"",
+			 RelationGetRelationName(matviewRel),
+			 RelationGetRelationName(baseRel));
+	state->baserti = rti;
+	x = -1;
+	while ((x = bms_next_member(rte->selectedCols, x)) >= 0)
+		state->nbaseargs = x + FirstLowInvalidHeapAttributeNumber;
+
+	state->ncolumns = desc->natts;
+	state->columns = (IvmColumn *) palloc0(desc->natts * sizeof(IvmColumn));
+	state->coltypes = (Oid *) palloc(desc->natts * sizeof(Oid));
+	for (i = 0; i < desc->natts; i++)
+		state->coltypes[i] = desc->attrs[i]->atttypid;
+
+	foreach(lc, state->query->targetList)
+	{
+		TargetEntry *tle = (TargetEntry *) lfirst(lc);
+		IvmColumn  *col = &state->columns[tle->resno - 1];
+		int			n;
+
+		if (IsA(tle->expr, Aggref))
+		{
+			char	   *aggname = get_func_name(((Aggref *) tle->expr)->aggfnoid);
+
+			if (strcmp(aggname, "count") == 0)
+				col->kind = IVM_COLUMN_COUNT;
+			else if (strcmp(aggname, "sum") == 0)
+				col->kind = IVM_COLUMN_SUM;
+			else
+				col->kind = IVM_COLUMN_AVG;
+		}
+		else
+			col->kind = IVM_COLUMN_KEY;
+
+		if (strcmp(tle->resname, IVM_COUNT_COLUMN) == 0)
+			state->countcol = tle->resno;
+		else if (sscanf(tle->resname, IVM_COLUMN_PREFIX "count_%d__", &n) == 1)
+			state->columns[n - 1].countcol = tle->resno;
+		else if (sscanf(tle->resname, IVM_COLUMN_PREFIX "sum_%d__", &n) == 1)
+			state->columns[n - 1].sumcol = tle->resno;
+	}
+
+	for (i = 0; i < state->ncolumns; i++)
+	{
+		IvmColumn  *col = &state->columns[i];
+
+		/* The hidden sum of an avg is counted by the avg's count */
+		if (col->kind == IVM_COLUMN_AVG)
+			state->columns[col->sumcol - 1].countcol = col->countcol;
+
+		if (col->kind == IVM_COLUMN_KEY)
+		{
+			if (state->nkeys >= IVM_MAX_KEYS)
+				elog(ERROR, "too many key columns in materialized view \"%s\"",
+					 RelationGetRelationName(matviewRel));
+			state->keys[state->nkeys++] = i + 1;
+		}
+	}
+}
+
+/*
+ * Apply the insertion or the deletion of a row of the table to the view.
+ */
+static void
+ivm_apply_change(IvmState *state, HeapTuple tuple, bool insert)
+{
+	TupleDesc	basedesc = RelationGetDescr(state->baseRel);
+	Datum	   *values;
+	char	   *nulls;
+	Datum	   *mvvalues;
+	bool	   *mvisnull;
+	char	   *mvnulls;
+	SPITupleTable *tuptable;
+	uint32		ntuples;
+	uint32		row;
+	int			i;
+
+	values = (Datum *) palloc((state->nbaseargs + 1) * sizeof(Datum));
+	nulls = (char *) palloc((state->nbaseargs + 1) * sizeof(char));
+	for (i = 0; i < state->nbaseargs; i++)
+	{
+		bool		isnull;
+
+		values[i] = heap_getattr(tuple, i + 1, basedesc, &isnull);
+		nulls[i] = isnull ? 'n' : ' ';
+	}
+
+	/* Without aggregates, new rows can go right into the view */
+	if (!state->aggregate && insert)
+	{
+		ivm_execute(ivm_get_plan(state, IVM_PLAN_INSERT_DELTA, 0),
+					values, nulls, SPI_OK_INSERT);
+		return;
+	}
+
+	ivm_execute(ivm_get_plan(state, IVM_PLAN_DELTA, 0),
+				values, nulls, SPI_OK_SELECT);
+	tuptable = SPI_tuptable;
+	ntuples = SPI_processed;
+
+	mvvalues = (Datum *) palloc(state->ncolumns * sizeof(Datum));
+	mvisnull = (bool *) palloc(state->ncolumns * sizeof(bool));
+	mvnulls = (char *) palloc(state->ncolumns * sizeof(char));
+
+	for (row = 0; row < ntuples; row++)
+	{
+		uint64		nullmask = 0;
+
+		heap_deform_tuple(tuptable->vals[row], tuptable->tupdesc,
+						  mvvalues, mvisnull);
+		for (i = 0; i < state->ncolumns; i++)
+			mvnulls[i] = mvisnull[i] ? 'n' : ' ';
+		for (i = 0; i < state->nkeys; i++)
+		{
+			if (mvisnull[state->keys[i] - 1])
+				nullmask |= UINT64CONST(1) << i;
+		}
+
+		if (!state->aggregate)
+		{
+			ivm_execute(ivm_get_plan(state, IVM_PLAN_DELETE_ROW, nullmask),
+						mvvalues, mvnulls, SPI_OK_DELETE);
+			continue;
+		}
+
+		/* The single group of a view without GROUP BY may not change */
+		if (!state->grouped &&
+			DatumGetInt64(mvvalues[state->countcol - 1]) == 0)
+			continue;
+
+		if (insert)
+		{
+			ivm_execute(ivm_get_plan(state, IVM_PLAN_ADD_GROUP, nullmask),
+						mvvalues, mvnulls, SPI_OK_UPDATE);
+			if (SPI_processed == 0)
+				ivm_execute(ivm_get_plan(state, IVM_PLAN_INSERT_GROUP, 0),
+							mvvalues, mvnulls, SPI_OK_INSERT);
+		}
+		else
+		{
+			if (state->grouped)
+			{
+				ivm_execute(ivm_get_plan(state, IVM_PLAN_DELETE_GROUP,
+										 nullmask),
+							mvvalues, mvnulls, SPI_OK_DELETE);
+				if (SPI_processed > 0)
+					continue;
+			}
+			ivm_execute(ivm_get_plan(state, IVM_PLAN_SUB_GROUP, nullmask),
+						mvvalues, mvnulls, SPI_OK_UPDATE);
+		}
+	}
+
+	SPI_freetuptable(tuptable);
+}
+
+/*
+ * Fetch a saved plan of the given kind for the view, or make it.
+ *
+ * As in ri_triggers.c, a plan that has become invalid is rebuilt from
+ * scratch rather than replanned, since the query text includes the names of
+ * the view's columns.
+ */
+static SPIPlanPtr
+ivm_get_plan(IvmState *state, IvmPlanKind kind, uint64 nullmask)
+{
+	IvmPlanKey	key;
+	IvmPlanEntry *entry;
+	SPIPlanPtr	plan;
+	StringInfoData querybuf;
+	const char *matviewname;
+	int			nargs;
+	Oid		   *argtypes;
+	int			i;
+
+	if (ivm_plan_cache == NULL)
+	{
+		HASHCTL		ctl;
+
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(IvmPlanKey);
+		ctl.entrysize = sizeof(IvmPlanEntry);
+		ivm_plan_cache = hash_create("incremental matview plan cache", 64,
+									 &ctl, HASH_ELEM | HASH_BLOBS);
+	}
+
+	memset(&key, 0, sizeof(key));
+	key.matviewid = RelationGetRelid(state->matviewRel);
+	if (kind == IVM_PLAN_DELTA || kind == IVM_PLAN_INSERT_DELTA)
+		key.relid = RelationGetRelid(state->baseRel);
+	key.kind = kind;
+	key.nullmask = nullmask;
+
+	entry = (IvmPlanEntry *) hash_search(ivm_plan_cache, &key,
+										 HASH_FIND, NULL);
+	if (entry != NULL)
+	{
+		plan = entry->plan;
+		if (plan && SPI_plan_is_valid(plan))
+			return plan;
+		entry->plan = NULL;
+		if (plan)
+			SPI_freeplan(plan);
+	}
+
+	matviewname = quote_qualified_identifier(get_namespace_name(RelationGetNamespace(state->matviewRel)),
+								   RelationGetRelationName(state->matviewRel));
+	nargs = state->ncolumns;
+	argtypes = state->coltypes;
+
+	initStringInfo(&querybuf);
+	switch (kind)
+	{
+		case IVM_PLAN_DELTA:
+		case IVM_PLAN_INSERT_DELTA:
+			{
+				TupleDesc	basedesc = RelationGetDescr(state->baseRel);
+
+				if (kind == IVM_PLAN_INSERT_DELTA)
+					appendStringInfo(&querybuf, "INSERT INTO %s ",
+									 matviewname);
+				appendStringInfoString(&querybuf, ivm_delta_query(state));
+
+				nargs = state->nbaseargs;
+				argtypes = (Oid *) palloc((nargs + 1) * sizeof(Oid));
+				for (i = 0; i < nargs; i++)
+				{
+					if (basedesc->attrs[i]->attisdropped)
+						argtypes[i] = INT4OID;
+					else
+						argtypes[i] = basedesc->attrs[i]->atttypid;
+				}
+			}
+			break;
+		case IVM_PLAN_DELETE_ROW:
+			/* Rows may be duplicated; remove just one */
+			appendStringInfo(&querybuf,
+							 "DELETE FROM %s WHERE ctid OPERATOR(pg_catalog.=) "
+							 "(SELECT ctid FROM %s WHERE ",
+							 matviewname, matviewname);
+			ivm_append_keys(&querybuf, state, nullmask);
+			appendStringInfoString(&querybuf, " LIMIT 1)");
+			break;
+		case IVM_PLAN_ADD_GROUP:
+		case IVM_PLAN_SUB_GROUP:
+			appendStringInfo(&querybuf, "UPDATE %s SET ", matviewname);
+			ivm_append_set_list(&querybuf, state, kind == IVM_PLAN_ADD_GROUP);
+			if (state->nkeys > 0)
+			{
+				appendStringInfoString(&querybuf, " WHERE ");
+				ivm_append_keys(&querybuf, state, nullmask);
+			}
+			break;
+		case IVM_PLAN_DELETE_GROUP:
+			appendStringInfo(&querybuf, "DELETE FROM %s WHERE ", matviewname);
+			ivm_append_keys(&querybuf, state, nullmask);
+			appendStringInfo(&querybuf, " AND %s OPERATOR(pg_catalog.=) $%d",
+							 ivm_column_name(state, state->countcol),
+							 state->countcol);
+			break;
+		case IVM_PLAN_INSERT_GROUP:
+			appendStringInfo(&querybuf, "INSERT INTO %s VALUES (",
+							 matviewname);
+			for (i = 1; i <= state->ncolumns; i++)
+				appendStringInfo(&querybuf, "%s$%d", i > 1 ? ", " : "", i);
+			appendStringInfoChar(&querybuf, ')');
+			break;
+		case IVM_PLAN_RECOMPUTE:
+			appendStringInfo(&querybuf, "DELETE FROM %s; INSERT INTO %s %s",
+							 matviewname, matviewname,
+							 pg_get_querydef(state->query));
+			nargs = 0;
+			break;
+	}
+
+	plan = SPI_prepare(querybuf.data, nargs, argtypes);
+	if (plan == NULL)
+		elog(ERROR, "SPI_prepare returned %d for %s", SPI_result,
+			 querybuf.data);
+	SPI_keepplan(plan);
+
+	entry = (IvmPlanEntry *) hash_search(ivm_plan_cache, &key,
+										 HASH_ENTER, NULL);
+	entry->plan = plan;
+
+	return plan;
+}
+
+static void
+ivm_execute(SPIPlanPtr plan, Datum *values, char *nulls, int expected)
+{
+	int			rc;
+
+	rc = SPI_execute_snapshot(plan, values, nulls,
+							  GetLatestSnapshot(), InvalidSnapshot,
+							  false, true, 0);
+	if (rc != expected)
+		elog(ERROR, "SPI_execute_snapshot returned %s",
+			 SPI_result_code_string(rc));
+}
+
+/*
+ * Text of the view's query with the changed table replaced by a single row
+ * given as parameters, $n being column n of the table.
+ */
+static char *
+ivm_delta_query(IvmState *state)
+{
+	Query	   *query = (Query *) copyObject(state->query);
+	RangeTblEntry *rte = rt_fetch(state->baserti, query->rtable);
+	TupleDesc	basedesc = RelationGetDescr(state->baseRel);
+	Query	   *subquery;
+	List	   *colnames = NIL;
+	AttrNumber	attno;
+
+	subquery = makeNode(Query);
+	subquery->commandType = CMD_SELECT;
+	subquery->querySource = QSRC_ORIGINAL;
+	subquery->canSetTag = true;
+	subquery->jointree = makeFromExpr(NIL, NULL);
+
+	for (attno = 1; attno <= state->nbaseargs; attno++)
+	{
+		Form_pg_attribute attr = basedesc->attrs[attno - 1];
+		Expr	   *expr;
+		char	   *colname;
+
+		if (bms_is_member(attno - FirstLowInvalidHeapAttributeNumber,
+						  rte->selectedCols))
+		{
+			Param	   *param = makeNode(Param);
+
+			param->paramkind = PARAM_EXTERN;
+			param->paramid = attno;
+			param->paramtype = attr->atttypid;
+			param->paramtypmod = attr->atttypmod;
+			param->paramcollid = attr->attcollation;
+			param->location = -1;
+			expr = (Expr *) param;
+			colname = pstrdup(NameStr(attr->attname));
+		}
+		else
+		{
+			expr = (Expr *) makeNullConst(INT4OID, -1, InvalidOid);
+			colname = psprintf("unused_%d", attno);
+		}
+		subquery->targetList = lappend(subquery->targetList,
+									   makeTargetEntry(expr, attno,
+													   colname, false));
+		colnames = lappend(colnames, makeString(colname));
+	}
+
+	rte->rtekind = RTE_SUBQUERY;
+	rte->subquery = subquery;
+	rte->security_barrier = false;
+	rte->relid = InvalidOid;
+	rte->relkind = 0;
+	rte->tablesample = NULL;
+	rte->inh = false;
+	rte->requiredPerms = 0;
+	rte->checkAsUser = InvalidOid;
+	rte->selectedCols = NULL;
+	rte->insertedCols = NULL;
+	rte->updatedCols = NULL;
+	rte->securityQuals = NIL;
+	rte->alias = makeAlias(rte->eref->aliasname, NIL);
+	rte->eref = makeAlias(rte->eref->aliasname, colnames);
+
+	return pg_get_querydef(query);
+}
+
+static const char *
+ivm_column_name(IvmState *state, AttrNumber attno)
+{
+	TupleDesc	desc = RelationGetDescr(state->matviewRel);
+
+	return quote_identifier(NameStr(desc->attrs[attno - 1]->attname));
+}
+
+/*
+ * Append a condition matching the view's rows, or groups, whose key columns
+ * equal the parameters with their column numbers; keys in nullmask are
+ * matched as NULL instead.
+ */
+static void
+ivm_append_keys(StringInfo buf, IvmState *state, uint64 nullmask)
+{
+	int			i;
+
+	if (state->nkeys == 0)
+		appendStringInfoString(buf, "true");
+
+	for (i = 0; i < state->nkeys; i++)
+	{
+		AttrNumber	attno = state->keys[i];
+		TypeCacheEntry *typentry;
+
+		if (i > 0)
+			appendStringInfoString(buf, " AND ");
+		appendStringInfo(buf, "%s ", ivm_column_name(state, attno));
+		if (nullmask & (UINT64CONST(1) << i))
+		{
+			appendStringInfoString(buf, "IS NULL");
+			continue;
+		}
+
+		typentry = lookup_type_cache(state->coltypes[attno - 1],
+									 TYPECACHE_EQ_OPR);
+		if (!OidIsValid(typentry->eq_opr))
+			ereport(ERROR,
+					(errcode(ERRCODE_UNDEFINED_FUNCTION),
+					 errmsg("could not identify an equality operator for type %s",
+							format_type_be(state->coltypes[attno - 1]))));
+		mv_GenerateOper(buf, typentry->eq_opr);
+		appendStringInfo(buf, " $%d", attno);
+	}
+}
+
+/*
+ * Append the SET list adding the aggregates given as parameters to those of
+ * a group, or subtracting them.
+ */
+static void
+ivm_append_set_list(StringInfo buf, IvmState *state, bool add)
+{
+	const char *op = add ? "OPERATOR(pg_catalog.+)" : "OPERATOR(pg_catalog.-)";
+	bool		first = true;
+	AttrNumber	attno;
+
+	for (attno = 1; attno <= state->ncolumns; attno++)
+	{
+		IvmColumn  *col = &state->columns[attno - 1];
+		const char *colname = ivm_column_name(state, attno);
+
+		if (col->kind == IVM_COLUMN_KEY)
+			continue;
+
+		if (!first)
+			appendStringInfoString(buf, ", ");
+		first = false;
+		appendStringInfo(buf, "%s = ", colname);
+
+		switch (col->kind)
+		{
+			case IVM_COLUMN_KEY:
+				break;
+			case IVM_COLUMN_COUNT:
+				appendStringInfo(buf, "%s %s $%d", colname, op, attno);
+				break;
+			case IVM_COLUMN_SUM:
+				ivm_append_sum(buf, state, attno, add);
+				break;
+			case IVM_COLUMN_AVG:
+				{
+					const char *count = ivm_column_name(state, col->countcol);
+					char	   *type = format_type_be(state->coltypes[attno - 1]);
+
+					appendStringInfo(buf,
+									 "CASE WHEN (%s %s $%d) OPERATOR(pg_catalog.=) 0 THEN NULL ELSE CAST(",
+									 count, op, col->countcol);
+					ivm_append_sum(buf, state, col->sumcol, add);
+					appendStringInfo(buf,
+									 " AS %s) OPERATOR(pg_catalog./) CAST((%s %s $%d) AS %s) END",
+									 type, count, op, col->countcol, type);
+				}
+				break;
+		}
+	}
+}
+
+/*
+ * Append the new value of a sum.  It is NULL when no input is left, and the
+ * parameter is NULL when the change has no inputs.
+ */
+static void
+ivm_append_sum(StringInfo buf, IvmState *state, AttrNumber attno, bool add)
+{
+	const char *op = add ? "OPERATOR(pg_catalog.+)" : "OPERATOR(pg_catalog.-)";
+	IvmColumn  *col = &state->columns[attno - 1];
+	const char *colname = ivm_column_name(state, attno);
+	const char *count = ivm_column_name(state, col->countcol);
+
+	appendStringInfo(buf,
+					 "CASE WHEN (%s %s $%d) OPERATOR(pg_catalog.=) 0 THEN NULL "
+					 "WHEN $%d OPERATOR(pg_catalog.=) 0 THEN %s ",
+					 count, op, col->countcol, col->countcol, colname);
+	if (add)
+		appendStringInfo(buf, "WHEN %s OPERATOR(pg_catalog.=) 0 THEN $%d ",
+						 count, attno);
+	appendStringInfo(buf, "ELSE (%s %s $%d) END", colname, op, attno);
+}
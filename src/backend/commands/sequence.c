@@ -33,7 +33,9 @@
 #include "nodes/makefuncs.h"
 #include "storage/lmgr.h"
 #include "storage/proc.h"
+#include "storage/shmem.h"
 #include "storage/smgr.h"
+#include "storage/spin.h"
 #include "utils/acl.h"
 #include "utils/builtins.h"
 #include "utils/lsyscache.h"
@@ -48,6 +50,15 @@
  */
 #define SEQ_LOG_VALS	32
 
+/*
+ * Number of sequences that can have values cached in shared memory at once
+ * (see sequence_shared_cache).
+ */
+#define NUM_SHARED_SEQUENCES	128
+
+/* GUC parameter */
+int			sequence_shared_cache = 0;
+
 /*
  * The "special area" of a sequence's buffer page looks like this.
  */
@@ -58,6 +69,30 @@ typedef struct sequence_magic
 	uint32		magic;
 } sequence_magic;
 
+/*
+ * A range of values of a sequence without CACHE, set aside in shared memory
+ * so that nextval() calls in all backends can hand them out without taking
+ * the lock on the sequence's buffer.  The sequence tuple on disk has already
+ * been advanced past the range, exactly as if some backend had cached it
+ * with a CACHE setting; so values that are never handed out (because of a
+ * crash or shutdown, or because the slot was reused) are skipped, as cached
+ * values are.  A slot is identified by database, sequence and relfilenode;
+ * it is unused if dbid is invalid, and empty if last == cached.  All fields
+ * but the mutex are protected by the mutex.
+ */
+typedef struct SeqSharedCache
+{
+	slock_t		mutex;
+	Oid			dbid;			/* database of the sequence */
+	Oid			relid;			/* pg_class OID of the sequence */
+	Oid			filenode;		/* relfilenode the range was taken from */
+	int64		last;			/* value last handed out */
+	int64		cached;			/* last value of the range */
+	int64		increment;		/* copy of sequence's increment field */
+} SeqSharedCache;
+
+static SeqSharedCache *SeqSharedCaches = NULL;
+
 /*
  * We store a SeqTable item for every sequence we have touched in the current
  * session.  This is needed to hold onto nextval/currval state.  (We can't
@@ -75,6 +110,8 @@ typedef struct SeqTableData
 	/* if last != cached, we have not used up all the cached values */
 	int64		increment;		/* copy of sequence's increment field */
 	/* note that increment is zero until we first do read_seq_tuple() */
+	SeqSharedCache *shared;		/* shared slot last used, or NULL */
+	bool		noshared;		/* sequence is not eligible for a slot */
 } SeqTableData;
 
 typedef SeqTableData *SeqTable;
@@ -97,6 +134,10 @@ static Form_pg_sequence read_seq_tuple(SeqTable elm, Relation rel,
 static void init_params(List *options, bool isInit,
 			Form_pg_sequence new, List **owned_by);
 static void do_setval(Oid relid, int64 next, bool iscalled);
+static SeqSharedCache *find_shared_cache(SeqTable elm, Relation rel,
+				  bool claim);
+static bool nextval_shared(SeqSharedCache *slot, SeqTable elm, Relation rel,
+			   int64 *result);
 static void process_owned_by(Relation seqrel, List *owned_by);
 
 
@@ -318,6 +359,9 @@ ResetSequence(Oid seq_relid)
 	/* Note that we do not change the currval() state */
 	elm->cached = elm->last;
 
+	/* The values cached in shared memory are no good anymore either */
+	ForgetSharedSequenceCaches(MyDatabaseId, seq_relid);
+
 	relation_close(seq_rel, NoLock);
 }
 
@@ -446,6 +490,9 @@ AlterSequence(AlterSeqStmt *stmt)
 	/* Note that we do not change the currval() state */
 	elm->cached = elm->last;
 
+	/* Likewise the values cached in shared memory */
+	ForgetSharedSequenceCaches(MyDatabaseId, relid);
+
 	/* check the comment above nextval_internal()'s equivalent call. */
 	if (RelationNeedsWAL(seqrel))
 		GetTopTransactionId();
@@ -549,7 +596,9 @@ nextval_internal(Oid relid)
 	int64		result,
 				next,
 				rescnt = 0;
+	int64		log_vals = SEQ_LOG_VALS;
 	bool		logit = false;
+	SeqSharedCache *slot = NULL;
 
 	/* open and AccessShareLock sequence */
 	init_sequence(relid, &elm, &seqrel);
@@ -582,6 +631,18 @@ nextval_internal(Oid relid)
 		return elm->last;
 	}
 
+	/* Try the values cached in shared memory, without locking the buffer */
+	if (sequence_shared_cache > 1 && !elm->noshared)
+	{
+		slot = find_shared_cache(elm, seqrel, false);
+		if (slot != NULL && nextval_shared(slot, elm, seqrel, &result))
+		{
+			relation_close(seqrel, NoLock);
+			last_used_seq = elm;
+			return result;
+		}
+	}
+
 	/* lock page' buffer and read tuple */
 	seq = read_seq_tuple(elm, seqrel, &buf, &seqtuple);
 	page = BufferGetPage(buf);
@@ -593,6 +654,33 @@ nextval_internal(Oid relid)
 	fetch = cache = seq->cache_value;
 	log = seq->log_cnt;
 
+	/*
+	 * A sequence without CACHE may have a range of values set aside in
+	 * shared memory instead.  If another backend has just refilled the range
+	 * while we were waiting for the buffer lock, use that; otherwise fetch a
+	 * new range, and WAL-log in steps of at least that many values.  Temp
+	 * sequences are only used by one backend, so don't bother for them.
+	 */
+	slot = NULL;
+	elm->noshared = (cache != 1 ||
+				seqrel->rd_rel->relpersistence == RELPERSISTENCE_TEMP);
+	if (sequence_shared_cache > 1 && !elm->noshared)
+	{
+		slot = find_shared_cache(elm, seqrel, true);
+		if (slot != NULL && nextval_shared(slot, elm, seqrel, &result))
+		{
+			UnlockReleaseBuffer(buf);
+			relation_close(seqrel, NoLock);
+			last_used_seq = elm;
+			return result;
+		}
+		if (slot != NULL)
+		{
+			fetch = cache = sequence_shared_cache;
+			log_vals = Max(SEQ_LOG_VALS, sequence_shared_cache);
+		}
+	}
+
 	if (!seq->is_called)
 	{
 		rescnt++;				/* return last_value if not is_called */
@@ -612,7 +700,7 @@ nextval_internal(Oid relid)
 	if (log < fetch || !seq->is_called)
 	{
 		/* forced log to satisfy local demand for values */
-		fetch = log = fetch + SEQ_LOG_VALS;
+		fetch = log = fetch + log_vals;
 		logit = true;
 	}
 	else
@@ -622,7 +710,7 @@ nextval_internal(Oid relid)
 		if (PageGetLSN(page) <= redoptr)
 		{
 			/* last update of seq was before checkpoint */
-			fetch = log = fetch + SEQ_LOG_VALS;
+			fetch = log = fetch + log_vals;
 			logit = true;
 		}
 	}
@@ -693,9 +781,9 @@ nextval_internal(Oid relid)
 	log -= fetch;				/* adjust for any unfetched numbers */
 	Assert(log >= 0);
 
-	/* save info in local cache */
+	/* save info in local cache, or in shared memory */
 	elm->last = result;			/* last returned number */
-	elm->cached = last;			/* last fetched number */
+	elm->cached = slot ? result : last;		/* last fetched number */
 	elm->last_valid = true;
 
 	last_used_seq = elm;
@@ -761,6 +849,19 @@ nextval_internal(Oid relid)
 
 	END_CRIT_SECTION();
 
+	/* Publish the rest of the range before anyone else can fetch again */
+	if (slot != NULL)
+	{
+		SpinLockAcquire(&slot->mutex);
+		slot->dbid = MyDatabaseId;
+		slot->relid = elm->relid;
+		slot->filenode = seqrel->rd_rel->relfilenode;
+		slot->last = result;
+		slot->cached = last;
+		slot->increment = incby;
+		SpinLockRelease(&slot->mutex);
+	}
+
 	UnlockReleaseBuffer(buf);
 
 	relation_close(seqrel, NoLock);
@@ -904,6 +1005,7 @@ do_setval(Oid relid, int64 next, bool iscalled)
 
 	/* In any case, forget any future cached numbers */
 	elm->cached = elm->last;
+	ForgetSharedSequenceCaches(MyDatabaseId, relid);
 
 	/* check the comment above nextval_internal()'s equivalent call. */
 	if (RelationNeedsWAL(seqrel))
@@ -1065,6 +1167,8 @@ init_sequence(Oid relid, SeqTable *p_elm, Relation *p_rel)
 		elm->lxid = InvalidLocalTransactionId;
 		elm->last_valid = false;
 		elm->last = elm->cached = elm->increment = 0;
+		elm->shared = NULL;
+		elm->noshared = false;
 	}
 
 	/*
@@ -1638,3 +1742,154 @@ ResetSequenceCaches(void)
 
 	last_used_seq = NULL;
 }
+
+
+/*
+ * Look for the shared-memory slot of a sequence.
+ *
+ * If there is none and claim is true, take over an unused or empty slot for
+ * it; the caller must hold the lock on the sequence's buffer, and fill the
+ * slot before releasing it.  Returns NULL if no slot is to be had.
+ */
+static SeqSharedCache *
+find_shared_cache(SeqTable elm, Relation rel, bool claim)
+{
+	Oid			filenode = rel->rd_rel->relfilenode;
+	SeqSharedCache *slot;
+	int			i;
+
+	/* The slot we used last time is the likeliest candidate */
+	slot = elm->shared;
+	if (slot != NULL &&
+		slot->dbid == MyDatabaseId && slot->relid == elm->relid)
+		return slot;
+
+	/*
+	 * Unlocked reads of the keys are fine here; nextval_shared checks them
+	 * again under the mutex.
+	 */
+	for (i = 0; i < NUM_SHARED_SEQUENCES; i++)
+	{
+		slot = &SeqSharedCaches[i];
+		if (slot->dbid == MyDatabaseId && slot->relid == elm->relid)
+		{
+			elm->shared = slot;
+			return slot;
+		}
+	}
+
+	if (!claim)
+		return NULL;
+
+	for (i = 0; i < NUM_SHARED_SEQUENCES; i++)
+	{
+		bool		usable;
+
+		slot = &SeqSharedCaches[i];
+		SpinLockAcquire(&slot->mutex);
+		usable = (!OidIsValid(slot->dbid) || slot->last == slot->cached);
+		if (usable)
+		{
+			slot->dbid = MyDatabaseId;
+			slot->relid = elm->relid;
+			slot->filenode = filenode;
+			slot->last = slot->cached = 0;
+		}
+		SpinLockRelease(&slot->mutex);
+
+		if (usable)
+		{
+			elm->shared = slot;
+			return slot;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Hand out the next value of a sequence's shared-memory range, if it has
+ * one left.
+ */
+static bool
+nextval_shared(SeqSharedCache *slot, SeqTable elm, Relation rel,
+			   int64 *result)
+{
+	bool		found = false;
+
+	SpinLockAcquire(&slot->mutex);
+	if (slot->dbid == MyDatabaseId &&
+		slot->relid == elm->relid &&
+		slot->filenode == rel->rd_rel->relfilenode &&
+		slot->last != slot->cached)
+	{
+		slot->last += slot->increment;
+		*result = slot->last;
+		found = true;
+	}
+	SpinLockRelease(&slot->mutex);
+
+	if (found)
+	{
+		/* this is now the currval() state; nothing is cached locally */
+		elm->last = elm->cached = *result;
+		elm->last_valid = true;
+	}
+
+	return found;
+}
+
+/*
+ * Throw away the values of a sequence cached in shared memory, or of all
+ * sequences of a database if relid is InvalidOid.
+ *
+ * This is called whenever a sequence is reset, altered or dropped, so that
+ * no values issued before the change are handed out after it, and so that a
+ * later sequence that happens to get the same OIDs doesn't pick them up.
+ */
+void
+ForgetSharedSequenceCaches(Oid dbid, Oid relid)
+{
+	int			i;
+
+	for (i = 0; i < NUM_SHARED_SEQUENCES; i++)
+	{
+		SeqSharedCache *slot = &SeqSharedCaches[i];
+
+		SpinLockAcquire(&slot->mutex);
+		if (slot->dbid == dbid &&
+			(!OidIsValid(relid) || slot->relid == relid))
+		{
+			slot->dbid = InvalidOid;
+			slot->relid = InvalidOid;
+			slot->last = slot->cached = 0;
+		}
+		SpinLockRelease(&slot->mutex);
+	}
+}
+
+/*
+ * Shared memory needed by sequence_shared_cache
+ */
+Size
+SequenceShmemSize(void)
+{
+	return mul_size(NUM_SHARED_SEQUENCES, sizeof(SeqSharedCache));
+}
+
+void
+SequenceShmemInit(void)
+{
+	bool		found;
+	int			i;
+
+	SeqSharedCaches = (SeqSharedCache *)
+		ShmemInitStruct("Sequence Caches", SequenceShmemSize(), &found);
+
+	if (!found)
+	{
+		MemSet(SeqSharedCaches, 0, SequenceShmemSize());
+		for (i = 0; i < NUM_SHARED_SEQUENCES; i++)
+			SpinLockInit(&SeqSharedCaches[i].mutex);
+	}
+}
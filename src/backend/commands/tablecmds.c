@@ -7117,7 +7117,7 @@ transformFkeyCheckAttrs(Relation pkrel,
 		 * partial index; forget it if there are any expressions, too. Invalid
 		 * indexes are out as well.
 		 */
-		if (indexStruct->indnatts == numattrs &&
+		if (indexStruct->indnkeyatts == numattrs &&
 			indexStruct->indisunique &&
 			IndexIsValid(indexStruct) &&
 			heap_attisnull(indexTuple, Anum_pg_index_indpred) &&
@@ -7407,6 +7407,8 @@ validateForeignKeyConstraint(char *conname,
 		trigdata.tg_trigger = &trig;
 		trigdata.tg_trigtuplebuf = scan->rs_cbuf;
 		trigdata.tg_newtuplebuf = InvalidBuffer;
+		trigdata.tg_oldtable = NULL;
+		trigdata.tg_newtable = NULL;
 
 		fcinfo.context = (Node *) &trigdata;
 
@@ -9744,16 +9746,22 @@ AlterTableMoveAll(AlterTableMoveAllStmt *stmt)
 
 /*
  * Copy data, block by block
+ *
+ * The source is read MAX_IO_COMBINE_BLOCKS blocks at a time, to save system
+ * calls; the pages are still WAL-logged and written out one by one.
  */
 static void
 copy_relation_data(SMgrRelation src, SMgrRelation dst,
 				   ForkNumber forkNum, char relpersistence)
 {
+	char	   *bufs;
+	char	   *pages[MAX_IO_COMBINE_BLOCKS];
 	char	   *buf;
 	Page		page;
 	bool		use_wal;
 	BlockNumber nblocks;
 	BlockNumber blkno;
+	int			i;
 
 	/*
 	 * palloc the buffer so that it's MAXALIGN'd.  If it were just a local
@@ -9761,8 +9769,9 @@ copy_relation_data(SMgrRelation src, SMgrRelation dst,
 	 * can seriously hurt transfer speed to and from the kernel; not to
 	 * mention possibly making log_newpage's accesses to the page header fail.
 	 */
-	buf = (char *) palloc(BLCKSZ);
-	page = (Page) buf;
+	bufs = (char *) palloc(BLCKSZ * MAX_IO_COMBINE_BLOCKS);
+	for (i = 0; i < MAX_IO_COMBINE_BLOCKS; i++)
+		pages[i] = bufs + BLCKSZ * i;
 
 	/*
 	 * We need to log the copied data in WAL iff WAL archiving/streaming is
@@ -9777,7 +9786,13 @@ copy_relation_data(SMgrRelation src, SMgrRelation dst,
 		/* If we got a cancel signal during the copy of the data, quit */
 		CHECK_FOR_INTERRUPTS();
 
-		smgrread(src, forkNum, blkno, buf);
+		/* read the next run of blocks when we've used up the last one */
+		i = blkno % MAX_IO_COMBINE_BLOCKS;
+		if (i == 0)
+			smgrreadv(src, forkNum, blkno, pages,
+					  Min(nblocks - blkno, MAX_IO_COMBINE_BLOCKS));
+		buf = pages[i];
+		page = (Page) buf;
 
 		if (!PageIsVerified(page, blkno))
 			ereport(ERROR,
@@ -9806,7 +9821,7 @@ copy_relation_data(SMgrRelation src, SMgrRelation dst,
 		smgrextend(dst, forkNum, blkno, buf, true);
 	}
 
-	pfree(buf);
+	pfree(bufs);
 
 	/*
 	 * If the rel is WAL-logged, must fsync before commit.  We use heap_sync
@@ -16,6 +16,7 @@
 #include "access/genam.h"
 #include "access/heapam.h"
 #include "access/sysattr.h"
+#include "access/tupconvert.h"
 #include "access/htup_details.h"
 #include "access/xact.h"
 #include "catalog/catalog.h"
@@ -30,6 +31,7 @@
 #include "commands/defrem.h"
 #include "commands/trigger.h"
 #include "executor/executor.h"
+#include "funcapi.h"
 #include "miscadmin.h"
 #include "nodes/bitmapset.h"
 #include "nodes/makefuncs.h"
@@ -72,7 +74,7 @@ static int	MyTriggerDepth = 0;
  * to be changed, however.
  */
 #define GetUpdatedColumns(relinfo, estate) \
-	(rt_fetch((relinfo)->ri_RangeTableIndex, (estate)->es_range_table)->updatedCols)
+	(exec_rt_fetch((relinfo)->ri_RangeTableIndex, estate)->updatedCols)
 
 /* Local function prototypes */
 static void ConvertTriggerToFK(CreateTrigStmt *stmt, Oid funcoid);
@@ -163,6 +165,8 @@ CreateTrigger(CreateTrigStmt *stmt, const char *queryString,
 	Oid			constrrelid = InvalidOid;
 	ObjectAddress myself,
 				referenced;
+	char	   *oldtablename = NULL;
+	char	   *newtablename = NULL;
 
 	if (OidIsValid(relOid))
 		rel = heap_open(relOid, ShareRowExclusiveLock);
@@ -308,6 +312,74 @@ CreateTrigger(CreateTrigStmt *stmt, const char *queryString,
 					 errmsg("INSTEAD OF triggers cannot have column lists")));
 	}
 
+	/*
+	 * Check the REFERENCING clause, if any.  Transition tables are only
+	 * collected for AFTER triggers on plain tables.
+	 */
+	if (stmt->transitionRels != NIL)
+	{
+		ListCell   *lc;
+
+		if (rel->rd_rel->relkind != RELKIND_RELATION)
+			ereport(ERROR,
+					(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+					 errmsg("\"%s\" is not a table",
+							RelationGetRelationName(rel)),
+					 errdetail("Triggers on views and foreign tables cannot have transition tables.")));
+		if (!TRIGGER_FOR_AFTER(tgtype))
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_OBJECT_DEFINITION),
+					 errmsg("transition table name can only be specified for an AFTER trigger")));
+		if (TRIGGER_FOR_TRUNCATE(tgtype))
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("TRUNCATE triggers with transition tables are not supported")));
+
+		foreach(lc, stmt->transitionRels)
+		{
+			TriggerTransition *tt = (TriggerTransition *) lfirst(lc);
+
+			if (!tt->isTable)
+				ereport(ERROR,
+						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						 errmsg("ROW variable naming in the REFERENCING clause is not supported"),
+						 errhint("Use OLD TABLE or NEW TABLE for naming transition tables.")));
+
+			if (tt->isNew)
+			{
+				if (!(TRIGGER_FOR_INSERT(tgtype) ||
+					  TRIGGER_FOR_UPDATE(tgtype)))
+					ereport(ERROR,
+							(errcode(ERRCODE_INVALID_OBJECT_DEFINITION),
+							 errmsg("NEW TABLE can only be specified for an INSERT or UPDATE trigger")));
+				if (newtablename != NULL)
+					ereport(ERROR,
+							(errcode(ERRCODE_INVALID_OBJECT_DEFINITION),
+							 errmsg("NEW TABLE cannot be specified multiple times")));
+				newtablename = tt->name;
+			}
+			else
+			{
+				if (!(TRIGGER_FOR_DELETE(tgtype) ||
+					  TRIGGER_FOR_UPDATE(tgtype)))
+					ereport(ERROR,
+							(errcode(ERRCODE_INVALID_OBJECT_DEFINITION),
+							 errmsg("OLD TABLE can only be specified for a DELETE or UPDATE trigger")));
+				if (oldtablename != NULL)
+					ereport(ERROR,
+							(errcode(ERRCODE_INVALID_OBJECT_DEFINITION),
+							 errmsg("OLD TABLE cannot be specified multiple times")));
+				oldtablename = tt->name;
+			}
+		}
+
+		if (newtablename != NULL && oldtablename != NULL &&
+			strcmp(newtablename, oldtablename) == 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_OBJECT_DEFINITION),
+					 errmsg("OLD TABLE name and NEW TABLE name cannot be the same")));
+	}
+
 	/*
 	 * Parse the WHEN clause, if any
 	 */
@@ -665,6 +737,18 @@ CreateTrigger(CreateTrigStmt *stmt, const char *queryString,
 	else
 		nulls[Anum_pg_trigger_tgqual - 1] = true;
 
+	/* and the transition table names, if any */
+	if (oldtablename)
+		values[Anum_pg_trigger_tgoldtable - 1] = DirectFunctionCall1(namein,
+											  CStringGetDatum(oldtablename));
+	else
+		nulls[Anum_pg_trigger_tgoldtable - 1] = true;
+	if (newtablename)
+		values[Anum_pg_trigger_tgnewtable - 1] = DirectFunctionCall1(namein,
+											  CStringGetDatum(newtablename));
+	else
+		nulls[Anum_pg_trigger_tgnewtable - 1] = true;
+
 	tuple = heap_form_tuple(tgrel->rd_att, values, nulls);
 
 	/* force tuple to have the desired OID */
@@ -1591,6 +1675,18 @@ RelationBuildTriggers(Relation relation)
 			build->tgqual = TextDatumGetCString(datum);
 		else
 			build->tgqual = NULL;
+		datum = fastgetattr(htup, Anum_pg_trigger_tgoldtable,
+							tgrel->rd_att, &isnull);
+		if (!isnull)
+			build->tgoldtable = pstrdup(NameStr(*DatumGetName(datum)));
+		else
+			build->tgoldtable = NULL;
+		datum = fastgetattr(htup, Anum_pg_trigger_tgnewtable,
+							tgrel->rd_att, &isnull);
+		if (!isnull)
+			build->tgnewtable = pstrdup(NameStr(*DatumGetName(datum)));
+		else
+			build->tgnewtable = NULL;
 
 		numtrigs++;
 	}
@@ -1681,6 +1777,15 @@ SetTriggerFlags(TriggerDesc *trigdesc, Trigger *trigger)
 	trigdesc->trig_truncate_after_statement |=
 		TRIGGER_TYPE_MATCHES(tgtype, TRIGGER_TYPE_STATEMENT,
 							 TRIGGER_TYPE_AFTER, TRIGGER_TYPE_TRUNCATE);
+
+	trigdesc->trig_insert_new_table |=
+		(TRIGGER_FOR_INSERT(tgtype) && trigger->tgnewtable != NULL);
+	trigdesc->trig_update_old_table |=
+		(TRIGGER_FOR_UPDATE(tgtype) && trigger->tgoldtable != NULL);
+	trigdesc->trig_update_new_table |=
+		(TRIGGER_FOR_UPDATE(tgtype) && trigger->tgnewtable != NULL);
+	trigdesc->trig_delete_old_table |=
+		(TRIGGER_FOR_DELETE(tgtype) && trigger->tgoldtable != NULL);
 }
 
 /*
@@ -1730,6 +1835,10 @@ CopyTriggerDesc(TriggerDesc *trigdesc)
 		}
 		if (trigger->tgqual)
 			trigger->tgqual = pstrdup(trigger->tgqual);
+		if (trigger->tgoldtable)
+			trigger->tgoldtable = pstrdup(trigger->tgoldtable);
+		if (trigger->tgnewtable)
+			trigger->tgnewtable = pstrdup(trigger->tgnewtable);
 		trigger++;
 	}
 
@@ -1762,6 +1871,10 @@ FreeTriggerDesc(TriggerDesc *trigdesc)
 		}
 		if (trigger->tgqual)
 			pfree(trigger->tgqual);
+		if (trigger->tgoldtable)
+			pfree(trigger->tgoldtable);
+		if (trigger->tgnewtable)
+			pfree(trigger->tgnewtable);
 		trigger++;
 	}
 	pfree(trigdesc->triggers);
@@ -1840,6 +1953,18 @@ equalTriggerDescs(TriggerDesc *trigdesc1, TriggerDesc *trigdesc2)
 				return false;
 			else if (strcmp(trig1->tgqual, trig2->tgqual) != 0)
 				return false;
+			if (trig1->tgoldtable == NULL && trig2->tgoldtable == NULL)
+				 /* ok */ ;
+			else if (trig1->tgoldtable == NULL || trig2->tgoldtable == NULL)
+				return false;
+			else if (strcmp(trig1->tgoldtable, trig2->tgoldtable) != 0)
+				return false;
+			if (trig1->tgnewtable == NULL && trig2->tgnewtable == NULL)
+				 /* ok */ ;
+			else if (trig1->tgnewtable == NULL || trig2->tgnewtable == NULL)
+				return false;
+			else if (strcmp(trig1->tgnewtable, trig2->tgnewtable) != 0)
+				return false;
 		}
 	}
 	else if (trigdesc2 != NULL)
@@ -1956,6 +2081,8 @@ ExecBSInsertTriggers(EState *estate, ResultRelInfo *relinfo)
 		return;
 
 	LocTriggerData.type = T_TriggerData;
+	LocTriggerData.tg_oldtable = NULL;
+	LocTriggerData.tg_newtable = NULL;
 	LocTriggerData.tg_event = TRIGGER_EVENT_INSERT |
 		TRIGGER_EVENT_BEFORE;
 	LocTriggerData.tg_relation = relinfo->ri_RelationDesc;
@@ -2013,6 +2140,8 @@ ExecBRInsertTriggers(EState *estate, ResultRelInfo *relinfo,
 	int			i;
 
 	LocTriggerData.type = T_TriggerData;
+	LocTriggerData.tg_oldtable = NULL;
+	LocTriggerData.tg_newtable = NULL;
 	LocTriggerData.tg_event = TRIGGER_EVENT_INSERT |
 		TRIGGER_EVENT_ROW |
 		TRIGGER_EVENT_BEFORE;
@@ -2071,7 +2200,8 @@ ExecARInsertTriggers(EState *estate, ResultRelInfo *relinfo,
 {
 	TriggerDesc *trigdesc = relinfo->ri_TrigDesc;
 
-	if (trigdesc && trigdesc->trig_insert_after_row)
+	if (trigdesc &&
+		(trigdesc->trig_insert_after_row || trigdesc->trig_insert_new_table))
 		AfterTriggerSaveEvent(estate, relinfo, TRIGGER_EVENT_INSERT,
 							  true, NULL, trigtuple, recheckIndexes, NULL);
 }
@@ -2088,6 +2218,8 @@ ExecIRInsertTriggers(EState *estate, ResultRelInfo *relinfo,
 	int			i;
 
 	LocTriggerData.type = T_TriggerData;
+	LocTriggerData.tg_oldtable = NULL;
+	LocTriggerData.tg_newtable = NULL;
 	LocTriggerData.tg_event = TRIGGER_EVENT_INSERT |
 		TRIGGER_EVENT_ROW |
 		TRIGGER_EVENT_INSTEAD;
@@ -2155,6 +2287,8 @@ ExecBSDeleteTriggers(EState *estate, ResultRelInfo *relinfo)
 		return;
 
 	LocTriggerData.type = T_TriggerData;
+	LocTriggerData.tg_oldtable = NULL;
+	LocTriggerData.tg_newtable = NULL;
 	LocTriggerData.tg_event = TRIGGER_EVENT_DELETE |
 		TRIGGER_EVENT_BEFORE;
 	LocTriggerData.tg_relation = relinfo->ri_RelationDesc;
@@ -2226,6 +2360,8 @@ ExecBRDeleteTriggers(EState *estate, EPQState *epqstate,
 		trigtuple = fdw_trigtuple;
 
 	LocTriggerData.type = T_TriggerData;
+	LocTriggerData.tg_oldtable = NULL;
+	LocTriggerData.tg_newtable = NULL;
 	LocTriggerData.tg_event = TRIGGER_EVENT_DELETE |
 		TRIGGER_EVENT_ROW |
 		TRIGGER_EVENT_BEFORE;
@@ -2274,7 +2410,8 @@ ExecARDeleteTriggers(EState *estate, ResultRelInfo *relinfo,
 {
 	TriggerDesc *trigdesc = relinfo->ri_TrigDesc;
 
-	if (trigdesc && trigdesc->trig_delete_after_row)
+	if (trigdesc &&
+		(trigdesc->trig_delete_after_row || trigdesc->trig_delete_old_table))
 	{
 		HeapTuple	trigtuple;
 
@@ -2306,6 +2443,8 @@ ExecIRDeleteTriggers(EState *estate, ResultRelInfo *relinfo,
 	int			i;
 
 	LocTriggerData.type = T_TriggerData;
+	LocTriggerData.tg_oldtable = NULL;
+	LocTriggerData.tg_newtable = NULL;
 	LocTriggerData.tg_event = TRIGGER_EVENT_DELETE |
 		TRIGGER_EVENT_ROW |
 		TRIGGER_EVENT_INSTEAD;
@@ -2359,6 +2498,8 @@ ExecBSUpdateTriggers(EState *estate, ResultRelInfo *relinfo)
 	updatedCols = GetUpdatedColumns(relinfo, estate);
 
 	LocTriggerData.type = T_TriggerData;
+	LocTriggerData.tg_oldtable = NULL;
+	LocTriggerData.tg_newtable = NULL;
 	LocTriggerData.tg_event = TRIGGER_EVENT_UPDATE |
 		TRIGGER_EVENT_BEFORE;
 	LocTriggerData.tg_relation = relinfo->ri_RelationDesc;
@@ -2461,6 +2602,8 @@ ExecBRUpdateTriggers(EState *estate, EPQState *epqstate,
 
 
 	LocTriggerData.type = T_TriggerData;
+	LocTriggerData.tg_oldtable = NULL;
+	LocTriggerData.tg_newtable = NULL;
 	LocTriggerData.tg_event = TRIGGER_EVENT_UPDATE |
 		TRIGGER_EVENT_ROW |
 		TRIGGER_EVENT_BEFORE;
@@ -2529,7 +2672,9 @@ ExecARUpdateTriggers(EState *estate, ResultRelInfo *relinfo,
 {
 	TriggerDesc *trigdesc = relinfo->ri_TrigDesc;
 
-	if (trigdesc && trigdesc->trig_update_after_row)
+	if (trigdesc &&
+		(trigdesc->trig_update_after_row || trigdesc->trig_update_old_table ||
+		 trigdesc->trig_update_new_table))
 	{
 		HeapTuple	trigtuple;
 
@@ -2564,6 +2709,8 @@ ExecIRUpdateTriggers(EState *estate, ResultRelInfo *relinfo,
 	int			i;
 
 	LocTriggerData.type = T_TriggerData;
+	LocTriggerData.tg_oldtable = NULL;
+	LocTriggerData.tg_newtable = NULL;
 	LocTriggerData.tg_event = TRIGGER_EVENT_UPDATE |
 		TRIGGER_EVENT_ROW |
 		TRIGGER_EVENT_INSTEAD;
@@ -2631,6 +2778,8 @@ ExecBSTruncateTriggers(EState *estate, ResultRelInfo *relinfo)
 		return;
 
 	LocTriggerData.type = T_TriggerData;
+	LocTriggerData.tg_oldtable = NULL;
+	LocTriggerData.tg_newtable = NULL;
 	LocTriggerData.tg_event = TRIGGER_EVENT_TRUNCATE |
 		TRIGGER_EVENT_BEFORE;
 	LocTriggerData.tg_relation = relinfo->ri_RelationDesc;
@@ -3164,8 +3313,12 @@ typedef struct AfterTriggerEventList
  * fdw_tuplestores[query_depth] is a tuplestore containing the foreign tuples
  * needed for the current query.
  *
- * maxquerydepth is just the allocated length of query_stack and
- * fdw_tuplestores.
+ * transition_tables[query_depth] is a list of AfterTriggersTransition
+ * entries, one for each relation and event type for which the current query
+ * is collecting the OLD and/or NEW rows that transition tables are made of.
+ *
+ * maxquerydepth is just the allocated length of query_stack,
+ * fdw_tuplestores and transition_tables.
  *
  * state_stack is a stack of pointers to saved copies of the SET CONSTRAINTS
  * state data; each subtransaction level that modifies that state first
@@ -3195,7 +3348,8 @@ typedef struct AfterTriggersData
 	int			query_depth;	/* current query list index */
 	AfterTriggerEventList *query_stack; /* events pending from each query */
 	Tuplestorestate **fdw_tuplestores;	/* foreign tuples from each query */
-	int			maxquerydepth;	/* allocated len of above array */
+	List	  **transition_tables;	/* transition tables from each query */
+	int			maxquerydepth;	/* allocated len of above arrays */
 	MemoryContext event_cxt;	/* memory context for events, if any */
 
 	/* these fields are just for resetting at subtrans abort: */
@@ -3209,6 +3363,21 @@ typedef struct AfterTriggersData
 
 static AfterTriggersData afterTriggers;
 
+/*
+ * The OLD and NEW rows that one query changed in one relation, for one type
+ * of event.  For an UPDATE, both tuplestores are used.
+ */
+typedef struct AfterTriggersTransition
+{
+	Oid			relid;			/* relation the rows belong to */
+	TriggerEvent event;			/* TRIGGER_EVENT_INSERT etc */
+	Tuplestorestate *old_tuplestore;	/* OLD rows, or NULL */
+	Tuplestorestate *new_tuplestore;	/* NEW rows, or NULL */
+} AfterTriggersTransition;
+
+/* The AFTER trigger call currently in progress, for pg_transition_table() */
+static TriggerData *CurrentAfterTriggerData = NULL;
+
 static void AfterTriggerExecute(AfterTriggerEvent event,
 					Relation rel, TriggerDesc *trigdesc,
 					FmgrInfo *finfo,
@@ -3222,6 +3391,40 @@ static SetConstraintState SetConstraintStateAddItem(SetConstraintState state,
 						  Oid tgoid, bool tgisdeferred);
 
 
+/*
+ * Create a tuplestore for use by the current query's AFTER triggers.
+ */
+static Tuplestorestate *
+MakeAfterTriggerTuplestore(void)
+{
+	Tuplestorestate *ret;
+	MemoryContext oldcxt;
+	ResourceOwner saveResourceOwner;
+
+	/*
+	 * Make the tuplestore valid until end of transaction.  This is the
+	 * allocation lifespan of the associated events list, but we really only
+	 * need it until AfterTriggerEndQuery().
+	 */
+	oldcxt = MemoryContextSwitchTo(TopTransactionContext);
+	saveResourceOwner = CurrentResourceOwner;
+	PG_TRY();
+	{
+		CurrentResourceOwner = TopTransactionResourceOwner;
+		ret = tuplestore_begin_heap(false, false, work_mem);
+	}
+	PG_CATCH();
+	{
+		CurrentResourceOwner = saveResourceOwner;
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+	CurrentResourceOwner = saveResourceOwner;
+	MemoryContextSwitchTo(oldcxt);
+
+	return ret;
+}
+
 /*
  * Gets the current query fdw tuplestore and initializes it if necessary
  */
@@ -3233,36 +3436,72 @@ GetCurrentFDWTuplestore()
 	ret = afterTriggers.fdw_tuplestores[afterTriggers.query_depth];
 	if (ret == NULL)
 	{
-		MemoryContext oldcxt;
-		ResourceOwner saveResourceOwner;
-
-		/*
-		 * Make the tuplestore valid until end of transaction.  This is the
-		 * allocation lifespan of the associated events list, but we really
-		 * only need it until AfterTriggerEndQuery().
-		 */
-		oldcxt = MemoryContextSwitchTo(TopTransactionContext);
-		saveResourceOwner = CurrentResourceOwner;
-		PG_TRY();
-		{
-			CurrentResourceOwner = TopTransactionResourceOwner;
-			ret = tuplestore_begin_heap(false, false, work_mem);
-		}
-		PG_CATCH();
-		{
-			CurrentResourceOwner = saveResourceOwner;
-			PG_RE_THROW();
-		}
-		PG_END_TRY();
-		CurrentResourceOwner = saveResourceOwner;
-		MemoryContextSwitchTo(oldcxt);
-
+		ret = MakeAfterTriggerTuplestore();
 		afterTriggers.fdw_tuplestores[afterTriggers.query_depth] = ret;
 	}
 
 	return ret;
 }
 
+/*
+ * Gets the current query's transition table entry for the given relation
+ * and event type, creating it (with empty tuplestores for the kinds of rows
+ * the event has) if necessary.
+ */
+static AfterTriggersTransition *
+GetCurrentTransitionTables(Oid relid, TriggerEvent event)
+{
+	AfterTriggersTransition *trans;
+	MemoryContext oldcxt;
+	ListCell   *lc;
+
+	foreach(lc, afterTriggers.transition_tables[afterTriggers.query_depth])
+	{
+		trans = (AfterTriggersTransition *) lfirst(lc);
+		if (trans->relid == relid && trans->event == event)
+			return trans;
+	}
+
+	oldcxt = MemoryContextSwitchTo(TopTransactionContext);
+	trans = (AfterTriggersTransition *) palloc(sizeof(AfterTriggersTransition));
+	trans->relid = relid;
+	trans->event = event;
+	trans->old_tuplestore = NULL;
+	trans->new_tuplestore = NULL;
+	afterTriggers.transition_tables[afterTriggers.query_depth] =
+		lappend(afterTriggers.transition_tables[afterTriggers.query_depth],
+				trans);
+	MemoryContextSwitchTo(oldcxt);
+
+	if (event == TRIGGER_EVENT_UPDATE || event == TRIGGER_EVENT_DELETE)
+		trans->old_tuplestore = MakeAfterTriggerTuplestore();
+	if (event == TRIGGER_EVENT_UPDATE || event == TRIGGER_EVENT_INSERT)
+		trans->new_tuplestore = MakeAfterTriggerTuplestore();
+
+	return trans;
+}
+
+/*
+ * Release the transition tables collected at the given query depth.
+ */
+static void
+FreeTransitionTables(int depth)
+{
+	ListCell   *lc;
+
+	foreach(lc, afterTriggers.transition_tables[depth])
+	{
+		AfterTriggersTransition *trans = (AfterTriggersTransition *) lfirst(lc);
+
+		if (trans->old_tuplestore)
+			tuplestore_end(trans->old_tuplestore);
+		if (trans->new_tuplestore)
+			tuplestore_end(trans->new_tuplestore);
+	}
+	list_free_deep(afterTriggers.transition_tables[depth]);
+	afterTriggers.transition_tables[depth] = NIL;
+}
+
 /* ----------
  * afterTriggerCheckState()
  *
@@ -3543,6 +3782,14 @@ AfterTriggerExecute(AfterTriggerEvent event,
 	if (LocTriggerData.tg_trigger == NULL)
 		elog(ERROR, "could not find trigger %u", tgoid);
 
+	/*
+	 * The foreign key checks that RI_FKey_check queues up to do together
+	 * must be done before any other kind of trigger gets to run, since it
+	 * might look at or change the tables involved.
+	 */
+	if (RI_FKey_trigger_type(LocTriggerData.tg_trigger->tgfoid) != RI_TRIGGER_FK)
+		RI_FKey_flush_checks();
+
 	/*
 	 * If doing EXPLAIN ANALYZE, start charging time to this trigger. We want
 	 * to include time spent re-fetching tuples in the trigger cost.
@@ -3630,21 +3877,66 @@ AfterTriggerExecute(AfterTriggerEvent event,
 	 * Setup the remaining trigger information
 	 */
 	LocTriggerData.type = T_TriggerData;
+	LocTriggerData.tg_oldtable = NULL;
+	LocTriggerData.tg_newtable = NULL;
 	LocTriggerData.tg_event =
 		evtshared->ats_event & (TRIGGER_EVENT_OPMASK | TRIGGER_EVENT_ROW);
 	LocTriggerData.tg_relation = rel;
 
+	/*
+	 * Hand over the transition tables the trigger asked for.  Such triggers
+	 * can't be deferred, so they always fire at the end of the query that
+	 * collected the rows.
+	 */
+	if ((LocTriggerData.tg_trigger->tgoldtable ||
+		 LocTriggerData.tg_trigger->tgnewtable) &&
+		afterTriggers.query_depth >= 0 &&
+		afterTriggers.query_depth < afterTriggers.maxquerydepth)
+	{
+		AfterTriggersTransition *trans;
+
+		trans = GetCurrentTransitionTables(RelationGetRelid(rel),
+						 evtshared->ats_event & TRIGGER_EVENT_OPMASK);
+		if (LocTriggerData.tg_trigger->tgoldtable)
+		{
+			LocTriggerData.tg_oldtable = trans->old_tuplestore;
+			if (LocTriggerData.tg_oldtable)
+				tuplestore_rescan(LocTriggerData.tg_oldtable);
+		}
+		if (LocTriggerData.tg_trigger->tgnewtable)
+		{
+			LocTriggerData.tg_newtable = trans->new_tuplestore;
+			if (LocTriggerData.tg_newtable)
+				tuplestore_rescan(LocTriggerData.tg_newtable);
+		}
+	}
+
 	MemoryContextReset(per_tuple_context);
 
 	/*
 	 * Call the trigger and throw away any possibly returned updated tuple.
 	 * (Don't let ExecCallTriggerFunc measure EXPLAIN time.)
 	 */
-	rettuple = ExecCallTriggerFunc(&LocTriggerData,
-								   tgindx,
-								   finfo,
-								   NULL,
-								   per_tuple_context);
+	{
+		TriggerData *save_trigdata = CurrentAfterTriggerData;
+
+		CurrentAfterTriggerData = &LocTriggerData;
+		PG_TRY();
+		{
+			rettuple = ExecCallTriggerFunc(&LocTriggerData,
+										   tgindx,
+										   finfo,
+										   NULL,
+										   per_tuple_context);
+		}
+		PG_CATCH();
+		{
+			CurrentAfterTriggerData = save_trigdata;
+			PG_RE_THROW();
+		}
+		PG_END_TRY();
+		CurrentAfterTriggerData = save_trigdata;
+	}
 	if (rettuple != NULL &&
 		rettuple != LocTriggerData.tg_trigtuple &&
 		rettuple != LocTriggerData.tg_newtuple)
@@ -3865,6 +4157,10 @@ afterTriggerInvokeEvents(AfterTriggerEventList *events,
 				events->tailfree = chunk->freeptr;
 		}
 	}
+
+	/* Do the foreign key checks queued up by the events we fired */
+	RI_FKey_flush_checks();
+
 	if (slot1 != NULL)
 	{
 		ExecDropSingleTupleTableSlot(slot1);
@@ -4019,6 +4315,7 @@ AfterTriggerEndQuery(EState *estate)
 		tuplestore_end(fdw_tuplestore);
 		afterTriggers.fdw_tuplestores[afterTriggers.query_depth] = NULL;
 	}
+	FreeTransitionTables(afterTriggers.query_depth);
 	afterTriggerFreeEventList(&afterTriggers.query_stack[afterTriggers.query_depth]);
 
 	afterTriggers.query_depth--;
@@ -4095,6 +4392,12 @@ AfterTriggerFireDeferred(void)
 void
 AfterTriggerEndXact(bool isCommit)
 {
+	/*
+	 * Forget any foreign key checks queued up by a trigger event whose firing
+	 * was interrupted by an error.
+	 */
+	RI_FKey_discard_checks();
+
 	/*
 	 * Forget the pending-events list.
 	 *
@@ -4132,6 +4435,7 @@ AfterTriggerEndXact(bool isCommit)
 	 */
 	afterTriggers.query_stack = NULL;
 	afterTriggers.fdw_tuplestores = NULL;
+	afterTriggers.transition_tables = NULL;
 	afterTriggers.maxquerydepth = 0;
 	afterTriggers.state = NULL;
 
@@ -4239,7 +4543,13 @@ AfterTriggerEndSubXact(bool isCommit)
 	else
 	{
 		/*
-		 * Aborting.  It is possible subxact start failed before calling
+		 * Aborting.  Forget any foreign key checks queued up within this
+		 * subtransaction.
+		 */
+		RI_FKey_discard_checks();
+
+		/*
+		 * It is possible subxact start failed before calling
 		 * AfterTriggerBeginSubXact, in which case we mustn't risk touching
 		 * stack levels that aren't there.
 		 */
@@ -4264,6 +4574,7 @@ AfterTriggerEndSubXact(bool isCommit)
 					tuplestore_end(ts);
 					afterTriggers.fdw_tuplestores[afterTriggers.query_depth] = NULL;
 				}
+				FreeTransitionTables(afterTriggers.query_depth);
 
 				afterTriggerFreeEventList(&afterTriggers.query_stack[afterTriggers.query_depth]);
 			}
@@ -4343,6 +4654,9 @@ AfterTriggerEnlargeQueryState(void)
 		afterTriggers.fdw_tuplestores = (Tuplestorestate **)
 			MemoryContextAllocZero(TopTransactionContext,
 								   new_alloc * sizeof(Tuplestorestate *));
+		afterTriggers.transition_tables = (List **)
+			MemoryContextAllocZero(TopTransactionContext,
+								   new_alloc * sizeof(List *));
 		afterTriggers.maxquerydepth = new_alloc;
 	}
 	else
@@ -4361,6 +4675,11 @@ AfterTriggerEnlargeQueryState(void)
 		/* Clear newly-allocated slots for subsequent lazy initialization. */
 		memset(afterTriggers.fdw_tuplestores + old_alloc,
 			   0, (new_alloc - old_alloc) * sizeof(Tuplestorestate *));
+		afterTriggers.transition_tables = (List **)
+			repalloc(afterTriggers.transition_tables,
+					 new_alloc * sizeof(List *));
+		memset(afterTriggers.transition_tables + old_alloc,
+			   0, (new_alloc - old_alloc) * sizeof(List *));
 		afterTriggers.maxquerydepth = new_alloc;
 	}
 
@@ -4909,6 +5228,28 @@ AfterTriggerSaveEvent(EState *estate, ResultRelInfo *relinfo,
 			break;
 	}
 
+	/*
+	 * Collect the rows for any transition tables the statement's triggers
+	 * will want to see.
+	 */
+	if (row_trigger &&
+		((event == TRIGGER_EVENT_INSERT && trigdesc->trig_insert_new_table) ||
+		 (event == TRIGGER_EVENT_UPDATE &&
+		  (trigdesc->trig_update_old_table ||
+		   trigdesc->trig_update_new_table)) ||
+		 (event == TRIGGER_EVENT_DELETE && trigdesc->trig_delete_old_table)))
+	{
+		AfterTriggersTransition *trans;
+
+		trans = GetCurrentTransitionTables(RelationGetRelid(rel), event);
+		if (oldtup && trans->old_tuplestore &&
+			(event != TRIGGER_EVENT_UPDATE || trigdesc->trig_update_old_table))
+			tuplestore_puttuple(trans->old_tuplestore, oldtup);
+		if (newtup && trans->new_tuplestore &&
+			(event != TRIGGER_EVENT_UPDATE || trigdesc->trig_update_new_table))
+			tuplestore_puttuple(trans->new_tuplestore, newtup);
+	}
+
 	if (!(relkind == RELKIND_FOREIGN_TABLE && row_trigger))
 		new_event.ate_flags = (row_trigger && event == TRIGGER_EVENT_UPDATE) ?
 			AFTER_TRIGGER_2CTID : AFTER_TRIGGER_1CTID;
@@ -5022,3 +5363,93 @@ pg_trigger_depth(PG_FUNCTION_ARGS)
 {
 	PG_RETURN_INT32(MyTriggerDepth);
 }
+
+/*
+ * pg_transition_table
+ *
+ * Returns the rows of the named transition table of the AFTER trigger that
+ * is currently executing.  This is how trigger functions written in a
+ * procedural language get at the transition tables; C functions can use
+ * TriggerData's tg_oldtable and tg_newtable directly.  The caller describes
+ * the rows with a column definition list, which must match the table's
+ * columns by position.
+ */
+Datum
+pg_transition_table(PG_FUNCTION_ARGS)
+{
+	char	   *name = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TriggerData *trigdata = CurrentAfterTriggerData;
+	Tuplestorestate *source = NULL;
+	TupleDesc	reldesc;
+	TupleDesc	tupdesc;
+	TupleConversionMap *map;
+	TupleTableSlot *slot;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	/* Find the transition table among those the current trigger has */
+	if (trigdata != NULL)
+	{
+		Trigger    *trigger = trigdata->tg_trigger;
+
+		if (trigger->tgoldtable && strcmp(trigger->tgoldtable, name) == 0)
+			source = trigdata->tg_oldtable;
+		else if (trigger->tgnewtable && strcmp(trigger->tgnewtable, name) == 0)
+			source = trigdata->tg_newtable;
+	}
+	if (source == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_UNDEFINED_TABLE),
+				 errmsg("transition table \"%s\" does not exist", name),
+				 errhint("Transition tables can only be read by the AFTER trigger that names them in its REFERENCING clause.")));
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	reldesc = RelationGetDescr(trigdata->tg_relation);
+	map = convert_tuples_by_position(reldesc, tupdesc,
+				gettext_noop("column definition list does not match the transition table"));
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	slot = MakeSingleTupleTableSlot(reldesc);
+	tuplestore_rescan(source);
+	while (tuplestore_gettupleslot(source, true, false, slot))
+	{
+		HeapTuple	tuple = ExecFetchSlotTuple(slot);
+
+		if (map != NULL)
+		{
+			tuple = do_convert_tuple(tuple, map);
+			tuplestore_puttuple(tupstore, tuple);
+			heap_freetuple(tuple);
+		}
+		else
+			tuplestore_puttuple(tupstore, tuple);
+	}
+	ExecDropSingleTupleTableSlot(slot);
+
+	return (Datum) 0;
+}
@@ -4,24 +4,32 @@
  *	  Concurrent ("lazy") vacuuming.
  *
  *
- * The major space usage for LAZY VACUUM is storage for the array of dead
- * tuple TIDs, with the next biggest need being storage for per-disk-page
- * free space info.  We want to ensure we can vacuum even the very largest
- * relations with finite memory space usage.  To do that, we set upper bounds
- * on the number of tuples and pages we will keep track of at once.
+ * The major space usage for LAZY VACUUM is storage for the dead tuple TIDs,
+ * with the next biggest need being storage for per-disk-page free space
+ * info.  We want to ensure we can vacuum even the very largest relations
+ * with finite memory space usage.  To do that, we set upper bounds on the
+ * number of tuples and pages we will keep track of at once.
  *
  * We are willing to use at most maintenance_work_mem (or perhaps
- * autovacuum_work_mem) memory space to keep track of dead tuples.  We
- * initially allocate an array of TIDs of that size, with an upper limit that
- * depends on table size (this limit ensures we don't allocate a huge area
- * uselessly for vacuuming small tables).  If the array threatens to overflow,
- * we suspend the heap scan phase and perform a pass of index cleanup and page
- * compaction, then resume the heap scan with an empty TID array.
+ * autovacuum_work_mem) memory space to keep track of dead tuples.  The TIDs
+ * are stored compactly, grouped by heap block (see LVDeadTuples), in arrays
+ * that start small and grow as needed, so small tables don't allocate a huge
+ * area uselessly, and large ones aren't limited to MaxAllocSize.  If the
+ * storage threatens to overflow, we suspend the heap scan phase and perform
+ * a pass of index cleanup and page compaction, then resume the heap scan
+ * with empty storage.
  *
  * If we're processing a table with no indexes, we can just vacuum each page
  * as we go; there's no need to save up multiple tuples to minimize the number
  * of index scans performed.  So we don't use maintenance_work_mem memory for
- * the TID array, just enough to hold as many heap tuples as fit on one page.
+ * the TIDs, just enough to hold as many heap tuples as fit on one page.
+ *
+ * If max_parallel_maintenance_workers allows it and the relation has several
+ * large indexes, each pass of index vacuuming is done in parallel: the dead
+ * tuple TIDs are copied into a dynamic shared memory segment, and the leader
+ * and a number of background workers take indexes one at a time until all
+ * have been vacuumed.  The heap itself, and the final cleanup of each index,
+ * are still handled by the leader alone.
  *
  *
  * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
@@ -42,10 +50,13 @@
 #include "access/heapam_xlog.h"
 #include "access/htup_details.h"
 #include "access/multixact.h"
+#include "access/parallel.h"
 #include "access/transam.h"
 #include "access/visibilitymap.h"
+#include "access/xact.h"
 #include "access/xlog.h"
 #include "catalog/catalog.h"
+#include "catalog/pg_am.h"
 #include "catalog/storage.h"
 #include "commands/dbcommands.h"
 #include "commands/vacuum.h"
@@ -54,11 +65,15 @@
 #include "portability/instr_time.h"
 #include "postmaster/autovacuum.h"
 #include "storage/bufmgr.h"
+#include "storage/dsm_impl.h"
 #include "storage/freespace.h"
 #include "storage/lmgr.h"
+#include "storage/spin.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/pg_rusage.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
 #include "utils/timestamp.h"
 #include "utils/tqual.h"
 
@@ -84,19 +99,60 @@
 #define VACUUM_TRUNCATE_LOCK_WAIT_INTERVAL		50		/* ms */
 #define VACUUM_TRUNCATE_LOCK_TIMEOUT			5000	/* ms */
 
-/*
- * Guesstimation of number of dead tuples per page.  This is used to
- * provide an upper limit to memory allocated when vacuuming small
- * tables.
- */
-#define LAZY_ALLOC_TUPLES		MaxHeapTuplesPerPage
-
 /*
  * Before we consider skipping a page that's marked as clean in
  * visibility map, we must've seen at least this many clean pages.
  */
 #define SKIP_PAGES_THRESHOLD	((BlockNumber) 32)
 
+/*
+ * An index needs at least this many pages to be worth vacuuming in a worker
+ * of its own.
+ */
+#define PARALLEL_VACUUM_MIN_INDEX_PAGES	((BlockNumber) 1000)
+
+/* Keys for the parallel index vacuum state in the DSM segment's TOC */
+#define PARALLEL_KEY_VACUUM_SHARED		UINT64CONST(0xA000000000000001)
+#define PARALLEL_KEY_DEAD_TUPLES		UINT64CONST(0xA000000000000002)
+
+/*
+ * Dead tuple TIDs, kept for each heap block in block number order.
+ *
+ * Each block with dead tuples has an 8-byte LVDeadBlock entry.  Up to two
+ * offsets are stored inline in its data field.  Otherwise the data field
+ * points into the words array, at a header word giving the number of words
+ * that follow and whether they hold a sorted list of offsets or a bitmap of
+ * offsets, whichever takes less space.  A page full of dead tuples thus
+ * takes a few dozen bytes rather than 6 bytes per tuple, and a membership
+ * test is a binary search over blocks rather than over tuples.
+ */
+typedef struct LVDeadBlock
+{
+	BlockNumber blkno;
+	uint32		data;			/* inline offsets, or LV_DEAD_EXTERNAL and
+								 * index of the header in words */
+} LVDeadBlock;
+
+#define LV_DEAD_EXTERNAL		0x80000000
+#define LV_DEAD_BITMAP			0x8000	/* flag in a header word */
+#define LV_DEAD_NWORDS_MASK		0x7FFF
+
+/* Most words one block can take: a header and a bitmap of every offset */
+#define LV_DEAD_BLOCK_MAX_WORDS \
+	(1 + (MaxHeapTuplesPerPage + 15) / 16)
+
+typedef struct LVDeadTuples
+{
+	int64		num_tuples;		/* # of TIDs stored */
+	uint32		num_blocks;		/* # of entries used in blocks */
+	uint32		max_blocks;		/* # of entries allocated */
+	uint32		num_words;		/* # of entries used in words */
+	uint32		max_words;		/* # of entries allocated */
+	Size		max_bytes;		/* limit on the size of both arrays */
+	LVDeadBlock *blocks;
+	uint16	   *words;
+} LVDeadTuples;
+
 typedef struct LVRelStats
 {
 	/* hasindex = true means two-pass strategy; false means one-pass */
@@ -106,6 +162,7 @@ typedef struct LVRelStats
 	BlockNumber rel_pages;		/* total number of pages */
 	BlockNumber scanned_pages;	/* number of pages we examined */
 	BlockNumber pinskipped_pages;		/* # of pages we skipped due to a pin */
+	BlockNumber frozenskipped_pages;	/* # of frozen pages we skipped */
 	double		scanned_tuples; /* counts only tuples on scanned pages */
 	double		old_rel_tuples; /* previous value of pg_class.reltuples */
 	double		new_rel_tuples; /* new estimated total # of tuples */
@@ -113,16 +170,52 @@ typedef struct LVRelStats
 	BlockNumber pages_removed;
 	double		tuples_deleted;
 	BlockNumber nonempty_pages; /* actually, last nonempty page + 1 */
-	/* List of TIDs of tuples we intend to delete */
-	/* NB: this list is ordered by TID address */
-	int			num_dead_tuples;	/* current # of entries */
-	int			max_dead_tuples;	/* # slots allocated in array */
-	ItemPointer dead_tuples;	/* array of ItemPointerData */
+	/* TIDs of tuples we intend to delete, ordered by TID address */
+	LVDeadTuples dead_tuples;
 	int			num_index_scans;
 	TransactionId latestRemovedXid;
 	bool		lock_waiter_detected;
+	int			parallel_workers;	/* workers for index vacuuming, or 0 */
 } LVRelStats;
 
+/*
+ * Per-index state of a parallel index vacuum pass, in shared memory.  Each
+ * slot is only touched by the participant that claimed its index.
+ */
+typedef struct LVIndexSlot
+{
+	Oid			indexrelid;
+	bool		has_stats;		/* is stats valid yet? */
+	IndexBulkDeleteResult stats;	/* carried over between passes */
+} LVIndexSlot;
+
+/*
+ * Shared state of a parallel index vacuum pass.  The dead tuples' blocks and
+ * words arrays are stored separately, one after the other, under
+ * PARALLEL_KEY_DEAD_TUPLES.
+ */
+typedef struct LVShared
+{
+	/* Fields set up by the leader and not changed afterwards */
+	double		old_rel_tuples;
+	int64		num_dead_tuples;
+	uint32		num_dead_blocks;	/* size of the dead tuples' blocks array */
+	uint32		num_dead_words; /* and of their words array */
+	int			elevel;
+	int			cost_delay;		/* the leader's vacuum cost settings */
+	int			cost_limit;
+	int			nindexes;
+
+	/* The next index to claim, and buffer usage added in by the workers */
+	slock_t		mutex;
+	int			next_index;
+	int			page_hit;
+	int			page_miss;
+	int			page_dirty;
+
+	LVIndexSlot indexes[FLEXIBLE_ARRAY_MEMBER];
+} LVShared;
+
 
 /* A few variables that don't seem worth passing around as parameters */
 static int	elevel = -1;
@@ -139,24 +232,41 @@ static void lazy_scan_heap(Relation onerel, LVRelStats *vacrelstats,
 			   Relation *Irel, int nindexes, bool scan_all);
 static void lazy_vacuum_heap(Relation onerel, LVRelStats *vacrelstats);
 static bool lazy_check_needs_freeze(Buffer buf);
+static void lazy_vacuum_all_indexes(Relation onerel, Relation *Irel,
+						int nindexes, IndexBulkDeleteResult **indstats,
+						LVRelStats *vacrelstats);
 static void lazy_vacuum_index(Relation indrel,
 				  IndexBulkDeleteResult **stats,
 				  LVRelStats *vacrelstats);
+static int lazy_parallel_degree(Relation onerel, Relation *Irel,
+					 int nindexes);
+static void lazy_parallel_vacuum_indexes(Relation onerel, Relation *Irel,
+							 int nindexes, IndexBulkDeleteResult **indstats,
+							 LVRelStats *vacrelstats);
+static void lazy_parallel_vacuum_claim(LVShared *lvshared, Relation *Irel,
+						   LVRelStats *vacrelstats);
+static void lazy_parallel_vacuum_main(dsm_segment *seg, shm_toc *toc);
 static void lazy_cleanup_index(Relation indrel,
 				   IndexBulkDeleteResult *stats,
 				   LVRelStats *vacrelstats);
 static int lazy_vacuum_page(Relation onerel, BlockNumber blkno, Buffer buffer,
-				 int tupindex, LVRelStats *vacrelstats, Buffer *vmbuffer);
+				 uint32 blkindex, LVRelStats *vacrelstats, Buffer *vmbuffer);
 static void lazy_truncate_heap(Relation onerel, LVRelStats *vacrelstats);
 static BlockNumber count_nondeletable_pages(Relation onerel,
 						 LVRelStats *vacrelstats);
 static void lazy_space_alloc(LVRelStats *vacrelstats, BlockNumber relblocks);
-static void lazy_record_dead_tuple(LVRelStats *vacrelstats,
-					   ItemPointer itemptr);
+static bool lazy_space_reserve(LVDeadTuples *dead, uint32 nwords);
+static bool lazy_space_grow(LVDeadTuples *dead, void **array,
+				uint32 *maxelems, uint64 needed, Size elemsize, uint64 limit);
+static void lazy_record_dead_tuples(LVRelStats *vacrelstats,
+						BlockNumber blkno, OffsetNumber *offsets,
+						int noffsets);
+static int lazy_dead_block_offsets(LVDeadTuples *dead, uint32 blkindex,
+						OffsetNumber *offsets);
 static bool lazy_tid_reaped(ItemPointer itemptr, void *state);
-static int	vac_cmp_itemptr(const void *left, const void *right);
 static bool heap_page_is_all_visible(Relation rel, Buffer buf,
-						 TransactionId *visibility_cutoff_xid);
+						 TransactionId *visibility_cutoff_xid,
+						 bool *all_frozen);
 
 
 /*
@@ -253,7 +363,8 @@ lazy_vacuum_rel(Relation onerel, int options, VacuumParams *params,
 	 * NB: We need to check this before truncating the relation, because that
 	 * will change ->rel_pages.
 	 */
-	if (vacrelstats->scanned_pages < vacrelstats->rel_pages)
+	if ((vacrelstats->scanned_pages + vacrelstats->frozenskipped_pages)
+		< vacrelstats->rel_pages)
 	{
 		Assert(!scan_all);
 		scanned_all = false;
@@ -301,7 +412,7 @@ lazy_vacuum_rel(Relation onerel, int options, VacuumParams *params,
 		new_rel_tuples = vacrelstats->old_rel_tuples;
 	}
 
-	new_rel_allvisible = visibilitymap_count(onerel);
+	new_rel_allvisible = visibilitymap_count(onerel, NULL);
 	if (new_rel_allvisible > new_rel_pages)
 		new_rel_allvisible = new_rel_pages;
 
@@ -360,10 +471,11 @@ lazy_vacuum_rel(Relation onerel, int options, VacuumParams *params,
 							 get_namespace_name(RelationGetNamespace(onerel)),
 							 RelationGetRelationName(onerel),
 							 vacrelstats->num_index_scans);
-			appendStringInfo(&buf, _("pages: %u removed, %u remain, %u skipped due to pins\n"),
+			appendStringInfo(&buf, _("pages: %u removed, %u remain, %u skipped due to pins, %u skipped frozen\n"),
 							 vacrelstats->pages_removed,
 							 vacrelstats->rel_pages,
-							 vacrelstats->pinskipped_pages);
+							 vacrelstats->pinskipped_pages,
+							 vacrelstats->frozenskipped_pages);
 			appendStringInfo(&buf,
 							 _("tuples: %.0f removed, %.0f remain, %.0f are dead but not yet removable\n"),
 							 vacrelstats->tuples_deleted,
@@ -452,8 +564,9 @@ lazy_scan_heap(Relation onerel, LVRelStats *vacrelstats,
 	int			i;
 	PGRUsage	ru0;
 	Buffer		vmbuffer = InvalidBuffer;
-	BlockNumber next_not_all_visible_block;
-	bool		skipping_all_visible_blocks;
+	BlockNumber next_unskippable_block;
+	bool		skipping_blocks;
+	BlockNumber prefetch_blkno = 0;
 	xl_heap_freeze_tuple *frozen;
 	StringInfoData buf;
 
@@ -468,12 +581,16 @@ lazy_scan_heap(Relation onerel, LVRelStats *vacrelstats,
 	empty_pages = vacuumed_pages = 0;
 	num_tuples = tups_vacuumed = nkeep = nunused = 0;
 
+	vacrelstats->parallel_workers = lazy_parallel_degree(onerel, Irel,
+														 nindexes);
+
 	indstats = (IndexBulkDeleteResult **)
 		palloc0(nindexes * sizeof(IndexBulkDeleteResult *));
 
 	nblocks = RelationGetNumberOfBlocks(onerel);
 	vacrelstats->rel_pages = nblocks;
 	vacrelstats->scanned_pages = 0;
+	vacrelstats->frozenskipped_pages = 0;
 	vacrelstats->nonempty_pages = 0;
 	vacrelstats->latestRemovedXid = InvalidTransactionId;
 
@@ -491,38 +608,51 @@ lazy_scan_heap(Relation onerel, LVRelStats *vacrelstats,
 	 * of pages.
 	 *
 	 * Before entering the main loop, establish the invariant that
-	 * next_not_all_visible_block is the next block number >= blkno that's not
-	 * all-visible according to the visibility map, or nblocks if there's no
-	 * such block.  Also, we set up the skipping_all_visible_blocks flag,
-	 * which is needed because we need hysteresis in the decision: once we've
-	 * started skipping blocks, we may as well skip everything up to the next
-	 * not-all-visible block.
-	 *
-	 * Note: if scan_all is true, we won't actually skip any pages; but we
-	 * maintain next_not_all_visible_block anyway, so as to set up the
-	 * all_visible_according_to_vm flag correctly for each page.
+	 * next_unskippable_block is the next block number >= blkno that we can't
+	 * skip based on the visibility map, or nblocks if there's no such block.
+	 * A block is skippable if it is all-visible, or in a scan_all vacuum, if
+	 * it is all-frozen.  We also set up the skipping_blocks flag, which is
+	 * needed because we need hysteresis in the decision: once we've started
+	 * skipping blocks, we may as well skip everything up to the next
+	 * unskippable block.
 	 *
-	 * Note: The value returned by visibilitymap_test could be slightly
+	 * Note: The value returned by visibilitymap_get_status could be slightly
 	 * out-of-date, since we make this test before reading the corresponding
 	 * heap page or locking the buffer.  This is OK.  If we mistakenly think
-	 * that the page is all-visible when in fact the flag's just been cleared,
-	 * we might fail to vacuum the page.  But it's OK to skip pages when
-	 * scan_all is not set, so no great harm done; the next vacuum will find
-	 * them.  If we make the reverse mistake and vacuum a page unnecessarily,
-	 * it'll just be a no-op.
+	 * that the page is all-visible or all-frozen when in fact the flag's just
+	 * been cleared, we might fail to vacuum the page.  It's OK to skip pages
+	 * when scan_all is not set, so no great harm done; the next vacuum will
+	 * find them.  Even when scan_all is set, missing a page whose all-frozen
+	 * bit has just been cleared is harmless: any XIDs just added to it are
+	 * newer than the OldestXmin we computed, so they don't affect the value
+	 * to which we can safely set relfrozenxid, nor do new MultiXactIds affect
+	 * relminmxid.  If we make the reverse mistake and vacuum a page
+	 * unnecessarily, it'll just be a no-op.
 	 */
-	for (next_not_all_visible_block = 0;
-		 next_not_all_visible_block < nblocks;
-		 next_not_all_visible_block++)
+	for (next_unskippable_block = 0;
+		 next_unskippable_block < nblocks;
+		 next_unskippable_block++)
 	{
-		if (!visibilitymap_test(onerel, next_not_all_visible_block, &vmbuffer))
-			break;
+		uint8		vmstatus;
+
+		vmstatus = visibilitymap_get_status(onerel, next_unskippable_block,
+											&vmbuffer);
+		if (scan_all)
+		{
+			if ((vmstatus & VISIBILITYMAP_ALL_FROZEN) == 0)
+				break;
+		}
+		else
+		{
+			if ((vmstatus & VISIBILITYMAP_ALL_VISIBLE) == 0)
+				break;
+		}
 		vacuum_delay_point();
 	}
-	if (next_not_all_visible_block >= SKIP_PAGES_THRESHOLD)
-		skipping_all_visible_blocks = true;
+	if (next_unskippable_block >= SKIP_PAGES_THRESHOLD)
+		skipping_blocks = true;
 	else
-		skipping_all_visible_blocks = false;
+		skipping_blocks = false;
 
 	for (blkno = 0; blkno < nblocks; blkno++)
 	{
@@ -532,54 +662,85 @@ lazy_scan_heap(Relation onerel, LVRelStats *vacrelstats,
 					maxoff;
 		bool		tupgone,
 					hastup;
-		int			prev_dead_count;
+		int64		prev_dead_count;
+		OffsetNumber deadoffsets[MaxHeapTuplesPerPage];
+		int			ndeadoffsets;
 		int			nfrozen;
 		Size		freespace;
-		bool		all_visible_according_to_vm;
+		bool		all_visible_according_to_vm = false;
 		bool		all_visible;
+		bool		all_frozen = true;	/* provided all_visible is also true */
 		bool		has_dead_tuples;
 		TransactionId visibility_cutoff_xid = InvalidTransactionId;
 
-		if (blkno == next_not_all_visible_block)
+		if (blkno == next_unskippable_block)
 		{
-			/* Time to advance next_not_all_visible_block */
-			for (next_not_all_visible_block++;
-				 next_not_all_visible_block < nblocks;
-				 next_not_all_visible_block++)
+			/* Time to advance next_unskippable_block */
+			for (next_unskippable_block++;
+				 next_unskippable_block < nblocks;
+				 next_unskippable_block++)
 			{
-				if (!visibilitymap_test(onerel, next_not_all_visible_block,
-										&vmbuffer))
-					break;
+				uint8		vmskipflags;
+
+				vmskipflags = visibilitymap_get_status(onerel,
+													   next_unskippable_block,
+													   &vmbuffer);
+				if (scan_all)
+				{
+					if ((vmskipflags & VISIBILITYMAP_ALL_FROZEN) == 0)
+						break;
+				}
+				else
+				{
+					if ((vmskipflags & VISIBILITYMAP_ALL_VISIBLE) == 0)
+						break;
+				}
 				vacuum_delay_point();
 			}
 
 			/*
 			 * We know we can't skip the current block.  But set up
-			 * skipping_all_visible_blocks to do the right thing at the
-			 * following blocks.
+			 * skipping_blocks to do the right thing at the following blocks.
 			 */
-			if (next_not_all_visible_block - blkno > SKIP_PAGES_THRESHOLD)
-				skipping_all_visible_blocks = true;
+			if (next_unskippable_block - blkno > SKIP_PAGES_THRESHOLD)
+				skipping_blocks = true;
 			else
-				skipping_all_visible_blocks = false;
-			all_visible_according_to_vm = false;
+				skipping_blocks = false;
+
+			/*
+			 * Normally, the fact that we can't skip this block must mean that
+			 * it's not all-visible.  But in a scan_all vacuum we know only
+			 * that it's not all-frozen, so it might still be all-visible.
+			 */
+			if (scan_all && visibilitymap_test(onerel, blkno, &vmbuffer))
+				all_visible_according_to_vm = true;
 		}
 		else
 		{
-			/* Current block is all-visible */
-			if (skipping_all_visible_blocks && !scan_all)
+			/*
+			 * The current block is potentially skippable; if we've seen a
+			 * long enough run of skippable blocks to justify skipping it, do
+			 * so.  In a scan_all vacuum a skippable block is all-frozen, and
+			 * still counts as seen for the purpose of advancing relfrozenxid.
+			 */
+			if (skipping_blocks)
+			{
+				if (scan_all)
+					vacrelstats->frozenskipped_pages++;
 				continue;
+			}
 			all_visible_according_to_vm = true;
 		}
 
 		vacuum_delay_point();
 
 		/*
-		 * If we are close to overrunning the available space for dead-tuple
-		 * TIDs, pause and do a cycle of vacuuming before we tackle this page.
+		 * If there might not be enough space left for the dead-tuple TIDs of
+		 * this page, pause and do a cycle of vacuuming before we tackle it.
 		 */
-		if ((vacrelstats->max_dead_tuples - vacrelstats->num_dead_tuples) < MaxHeapTuplesPerPage &&
-			vacrelstats->num_dead_tuples > 0)
+		if (vacrelstats->dead_tuples.num_tuples > 0 &&
+			!lazy_space_reserve(&vacrelstats->dead_tuples,
+								LV_DEAD_BLOCK_MAX_WORDS))
 		{
 			/*
 			 * Before beginning index vacuuming, we release any pin we may
@@ -597,10 +758,8 @@ lazy_scan_heap(Relation onerel, LVRelStats *vacrelstats,
 			vacuum_log_cleanup_info(onerel, vacrelstats);
 
 			/* Remove index entries */
-			for (i = 0; i < nindexes; i++)
-				lazy_vacuum_index(Irel[i],
-								  &indstats[i],
-								  vacrelstats);
+			lazy_vacuum_all_indexes(onerel, Irel, nindexes, indstats,
+									vacrelstats);
 			/* Remove tuples from heap */
 			lazy_vacuum_heap(onerel, vacrelstats);
 
@@ -609,7 +768,9 @@ lazy_scan_heap(Relation onerel, LVRelStats *vacrelstats,
 			 * not to reset latestRemovedXid since we want that value to be
 			 * valid.
 			 */
-			vacrelstats->num_dead_tuples = 0;
+			vacrelstats->dead_tuples.num_tuples = 0;
+			vacrelstats->dead_tuples.num_blocks = 0;
+			vacrelstats->dead_tuples.num_words = 0;
 			vacrelstats->num_index_scans++;
 		}
 
@@ -617,12 +778,46 @@ lazy_scan_heap(Relation onerel, LVRelStats *vacrelstats,
 		 * Pin the visibility map page in case we need to mark the page
 		 * all-visible.  In most cases this will be very cheap, because we'll
 		 * already have the correct page pinned anyway.  However, it's
-		 * possible that (a) next_not_all_visible_block is covered by a
+		 * possible that (a) next_unskippable_block is covered by a
 		 * different VM page than the current block or (b) we released our pin
 		 * and did a cycle of index vacuuming.
 		 */
 		visibilitymap_pin(onerel, blkno, &vmbuffer);
 
+#ifdef USE_PREFETCH
+
+		/*
+		 * Issue read-ahead for the blocks we're going to read next.  Until
+		 * next_unskippable_block, either every block will be read (if we're
+		 * not skipping) or none will; beyond it we don't know yet, so that's
+		 * as far as we look.  Skipping blocks defeats the kernel's own
+		 * read-ahead, so this matters most when the visibility map lets us
+		 * skip large parts of the table.
+		 */
+		if (target_prefetch_pages > 0)
+		{
+			BlockNumber prefetch_limit;
+
+			if (skipping_blocks)
+			{
+				if (prefetch_blkno < next_unskippable_block)
+					prefetch_blkno = next_unskippable_block;
+				prefetch_limit = next_unskippable_block;
+			}
+			else
+			{
+				if (prefetch_blkno <= blkno)
+					prefetch_blkno = blkno + 1;
+				prefetch_limit = Min(blkno + target_prefetch_pages,
+									 next_unskippable_block);
+			}
+
+			for (; prefetch_blkno <= prefetch_limit && prefetch_blkno < nblocks;
+				 prefetch_blkno++)
+				PrefetchBuffer(onerel, MAIN_FORKNUM, prefetch_blkno);
+		}
+#endif   /* USE_PREFETCH */
+
 		buf = ReadBufferExtended(onerel, MAIN_FORKNUM, blkno,
 								 RBM_NORMAL, vac_strategy);
 
@@ -740,7 +935,8 @@ lazy_scan_heap(Relation onerel, LVRelStats *vacrelstats,
 
 				PageSetAllVisible(page);
 				visibilitymap_set(onerel, blkno, buf, InvalidXLogRecPtr,
-								  vmbuffer, InvalidTransactionId);
+								  vmbuffer, InvalidTransactionId,
+					   VISIBILITYMAP_ALL_VISIBLE | VISIBILITYMAP_ALL_FROZEN);
 				END_CRIT_SECTION();
 			}
 
@@ -765,7 +961,8 @@ lazy_scan_heap(Relation onerel, LVRelStats *vacrelstats,
 		has_dead_tuples = false;
 		nfrozen = 0;
 		hastup = false;
-		prev_dead_count = vacrelstats->num_dead_tuples;
+		prev_dead_count = vacrelstats->dead_tuples.num_tuples;
+		ndeadoffsets = 0;
 		maxoff = PageGetMaxOffsetNumber(page);
 
 		/*
@@ -804,7 +1001,7 @@ lazy_scan_heap(Relation onerel, LVRelStats *vacrelstats,
 			 */
 			if (ItemIdIsDead(itemid))
 			{
-				lazy_record_dead_tuple(vacrelstats, &(tuple.t_self));
+				deadoffsets[ndeadoffsets++] = offnum;
 				all_visible = false;
 				continue;
 			}
@@ -909,7 +1106,7 @@ lazy_scan_heap(Relation onerel, LVRelStats *vacrelstats,
 
 			if (tupgone)
 			{
-				lazy_record_dead_tuple(vacrelstats, &(tuple.t_self));
+				deadoffsets[ndeadoffsets++] = offnum;
 				HeapTupleHeaderAdvanceLatestRemovedXid(tuple.t_data,
 											 &vacrelstats->latestRemovedXid);
 				tups_vacuumed += 1;
@@ -917,6 +1114,8 @@ lazy_scan_heap(Relation onerel, LVRelStats *vacrelstats,
 			}
 			else
 			{
+				bool		tuple_totally_frozen;
+
 				num_tuples += 1;
 				hastup = true;
 
@@ -925,11 +1124,20 @@ lazy_scan_heap(Relation onerel, LVRelStats *vacrelstats,
 				 * freezing.  Note we already have exclusive buffer lock.
 				 */
 				if (heap_prepare_freeze_tuple(tuple.t_data, FreezeLimit,
-										  MultiXactCutoff, &frozen[nfrozen]))
+										  MultiXactCutoff, &frozen[nfrozen],
+											  &tuple_totally_frozen))
 					frozen[nfrozen++].offset = offnum;
+
+				if (!tuple_totally_frozen)
+					all_frozen = false;
 			}
 		}						/* scan along page */
 
+		/* Remember the page's deletable tuples */
+		if (ndeadoffsets > 0)
+			lazy_record_dead_tuples(vacrelstats, blkno, deadoffsets,
+									ndeadoffsets);
+
 		/*
 		 * If we froze any tuples, mark the buffer dirty, and write a WAL
 		 * record recording the changes.  We must log the changes to be
@@ -971,7 +1179,7 @@ lazy_scan_heap(Relation onerel, LVRelStats *vacrelstats,
 		 * instead of doing a second scan.
 		 */
 		if (nindexes == 0 &&
-			vacrelstats->num_dead_tuples > 0)
+			vacrelstats->dead_tuples.num_tuples > 0)
 		{
 			/* Remove tuples from heap */
 			lazy_vacuum_page(onerel, blkno, buf, 0, vacrelstats, &vmbuffer);
@@ -982,7 +1190,9 @@ lazy_scan_heap(Relation onerel, LVRelStats *vacrelstats,
 			 * not to reset latestRemovedXid since we want that value to be
 			 * valid.
 			 */
-			vacrelstats->num_dead_tuples = 0;
+			vacrelstats->dead_tuples.num_tuples = 0;
+			vacrelstats->dead_tuples.num_blocks = 0;
+			vacrelstats->dead_tuples.num_words = 0;
 			vacuumed_pages++;
 		}
 
@@ -991,6 +1201,11 @@ lazy_scan_heap(Relation onerel, LVRelStats *vacrelstats,
 		/* mark page all-visible, if appropriate */
 		if (all_visible && !all_visible_according_to_vm)
 		{
+			uint8		flags = VISIBILITYMAP_ALL_VISIBLE;
+
+			if (all_frozen)
+				flags |= VISIBILITYMAP_ALL_FROZEN;
+
 			/*
 			 * It should never be the case that the visibility map page is set
 			 * while the page-level bit is clear, but the reverse is allowed
@@ -1007,7 +1222,7 @@ lazy_scan_heap(Relation onerel, LVRelStats *vacrelstats,
 			PageSetAllVisible(page);
 			MarkBufferDirty(buf);
 			visibilitymap_set(onerel, blkno, buf, InvalidXLogRecPtr,
-							  vmbuffer, visibility_cutoff_xid);
+							  vmbuffer, visibility_cutoff_xid, flags);
 		}
 
 		/*
@@ -1022,7 +1237,8 @@ lazy_scan_heap(Relation onerel, LVRelStats *vacrelstats,
 		{
 			elog(WARNING, "page is not marked all-visible but visibility map bit is set in relation \"%s\" page %u",
 				 relname, blkno);
-			visibilitymap_clear(onerel, blkno, vmbuffer);
+			visibilitymap_clear(onerel, blkno, vmbuffer,
+								VISIBILITYMAP_VALID_BITS);
 		}
 
 		/*
@@ -1044,7 +1260,27 @@ lazy_scan_heap(Relation onerel, LVRelStats *vacrelstats,
 				 relname, blkno);
 			PageClearAllVisible(page);
 			MarkBufferDirty(buf);
-			visibilitymap_clear(onerel, blkno, vmbuffer);
+			visibilitymap_clear(onerel, blkno, vmbuffer,
+								VISIBILITYMAP_VALID_BITS);
+		}
+
+		/*
+		 * If the all-visible page is all-frozen but not marked as such yet,
+		 * mark it as all-frozen.  Note that all_frozen is only valid if
+		 * all_visible is true, so we must check both.
+		 */
+		else if (all_visible_according_to_vm && all_visible && all_frozen &&
+				 !(visibilitymap_get_status(onerel, blkno, &vmbuffer) &
+				   VISIBILITYMAP_ALL_FROZEN))
+		{
+			/*
+			 * We can pass InvalidTransactionId as the cutoff XID here,
+			 * because setting the all-frozen bit doesn't cause recovery
+			 * conflicts.
+			 */
+			visibilitymap_set(onerel, blkno, buf, InvalidXLogRecPtr,
+							  vmbuffer, InvalidTransactionId,
+							VISIBILITYMAP_ALL_VISIBLE | VISIBILITYMAP_ALL_FROZEN);
 		}
 
 		UnlockReleaseBuffer(buf);
@@ -1060,7 +1296,7 @@ lazy_scan_heap(Relation onerel, LVRelStats *vacrelstats,
 		 * page, so remember its free space as-is.  (This path will always be
 		 * taken if there are no indexes.)
 		 */
-		if (vacrelstats->num_dead_tuples == prev_dead_count)
+		if (vacrelstats->dead_tuples.num_tuples == prev_dead_count)
 			RecordPageWithFreeSpace(onerel, blkno, freespace);
 	}
 
@@ -1088,16 +1324,14 @@ lazy_scan_heap(Relation onerel, LVRelStats *vacrelstats,
 
 	/* If any tuples need to be deleted, perform final vacuum cycle */
 	/* XXX put a threshold on min number of tuples here? */
-	if (vacrelstats->num_dead_tuples > 0)
+	if (vacrelstats->dead_tuples.num_tuples > 0)
 	{
 		/* Log cleanup info before we touch indexes */
 		vacuum_log_cleanup_info(onerel, vacrelstats);
 
 		/* Remove index entries */
-		for (i = 0; i < nindexes; i++)
-			lazy_vacuum_index(Irel[i],
-							  &indstats[i],
-							  vacrelstats);
+		lazy_vacuum_all_indexes(onerel, Irel, nindexes, indstats,
+								vacrelstats);
 		/* Remove tuples from heap */
 		lazy_vacuum_heap(onerel, vacrelstats);
 		vacrelstats->num_index_scans++;
@@ -1155,16 +1389,18 @@ lazy_scan_heap(Relation onerel, LVRelStats *vacrelstats,
 static void
 lazy_vacuum_heap(Relation onerel, LVRelStats *vacrelstats)
 {
-	int			tupindex;
+	uint32		blkindex;
+	double		ntuples;
 	int			npages;
 	PGRUsage	ru0;
 	Buffer		vmbuffer = InvalidBuffer;
+	uint32		prefetch_index = 0;
 
 	pg_rusage_init(&ru0);
+	ntuples = 0;
 	npages = 0;
 
-	tupindex = 0;
-	while (tupindex < vacrelstats->num_dead_tuples)
+	for (blkindex = 0; blkindex < vacrelstats->dead_tuples.num_blocks; blkindex++)
 	{
 		BlockNumber tblk;
 		Buffer		buf;
@@ -1173,16 +1409,33 @@ lazy_vacuum_heap(Relation onerel, LVRelStats *vacrelstats)
 
 		vacuum_delay_point();
 
-		tblk = ItemPointerGetBlockNumber(&vacrelstats->dead_tuples[tupindex]);
+		/*
+		 * If we can't get a cleanup lock, leave the page alone; its dead
+		 * tuples become dead line pointers for the next vacuum to remove.
+		 */
+		tblk = vacrelstats->dead_tuples.blocks[blkindex].blkno;
+
+#ifdef USE_PREFETCH
+		/* we know exactly which blocks come next, so read ahead for them */
+		if (prefetch_index <= blkindex)
+			prefetch_index = blkindex + 1;
+		while (prefetch_index < vacrelstats->dead_tuples.num_blocks &&
+			   prefetch_index <= blkindex + target_prefetch_pages)
+		{
+			PrefetchBuffer(onerel, MAIN_FORKNUM,
+						   vacrelstats->dead_tuples.blocks[prefetch_index].blkno);
+			prefetch_index++;
+		}
+#endif   /* USE_PREFETCH */
+
 		buf = ReadBufferExtended(onerel, MAIN_FORKNUM, tblk, RBM_NORMAL,
 								 vac_strategy);
 		if (!ConditionalLockBufferForCleanup(buf))
 		{
 			ReleaseBuffer(buf);
-			++tupindex;
 			continue;
 		}
-		tupindex = lazy_vacuum_page(onerel, tblk, buf, tupindex, vacrelstats,
+		ntuples += lazy_vacuum_page(onerel, tblk, buf, blkindex, vacrelstats,
 									&vmbuffer);
 
 		/* Now that we've compacted the page, record its available space */
@@ -1201,9 +1454,9 @@ lazy_vacuum_heap(Relation onerel, LVRelStats *vacrelstats)
 	}
 
 	ereport(elevel,
-			(errmsg("\"%s\": removed %d row versions in %d pages",
+			(errmsg("\"%s\": removed %.0f row versions in %d pages",
 					RelationGetRelationName(onerel),
-					tupindex, npages),
+					ntuples, npages),
 			 errdetail("%s.",
 					   pg_rusage_show(&ru0))));
 }
@@ -1214,34 +1467,32 @@ lazy_vacuum_heap(Relation onerel, LVRelStats *vacrelstats)
  *
  * Caller must hold pin and buffer cleanup lock on the buffer.
  *
- * tupindex is the index in vacrelstats->dead_tuples of the first dead
- * tuple for this page.  We assume the rest follow sequentially.
- * The return value is the first tupindex after the tuples of this page.
+ * blkindex is the index in vacrelstats->dead_tuples of the entry for this
+ * page.  The return value is the number of tuples removed.
  */
 static int
 lazy_vacuum_page(Relation onerel, BlockNumber blkno, Buffer buffer,
-				 int tupindex, LVRelStats *vacrelstats, Buffer *vmbuffer)
+				 uint32 blkindex, LVRelStats *vacrelstats, Buffer *vmbuffer)
 {
 	Page		page = BufferGetPage(buffer);
 	OffsetNumber unused[MaxOffsetNumber];
-	int			uncnt = 0;
+	int			uncnt;
+	int			i;
 	TransactionId visibility_cutoff_xid;
+	bool		all_frozen;
+
+	Assert(vacrelstats->dead_tuples.blocks[blkindex].blkno == blkno);
+	uncnt = lazy_dead_block_offsets(&vacrelstats->dead_tuples, blkindex,
+									unused);
 
 	START_CRIT_SECTION();
 
-	for (; tupindex < vacrelstats->num_dead_tuples; tupindex++)
+	for (i = 0; i < uncnt; i++)
 	{
-		BlockNumber tblk;
-		OffsetNumber toff;
 		ItemId		itemid;
 
-		tblk = ItemPointerGetBlockNumber(&vacrelstats->dead_tuples[tupindex]);
-		if (tblk != blkno)
-			break;				/* past end of tuples for this block */
-		toff = ItemPointerGetOffsetNumber(&vacrelstats->dead_tuples[tupindex]);
-		itemid = PageGetItemId(page, toff);
+		itemid = PageGetItemId(page, unused[i]);
 		ItemIdSetUnused(itemid);
-		unused[uncnt++] = toff;
 	}
 
 	PageRepairFragmentation(page);
@@ -1277,22 +1528,33 @@ lazy_vacuum_page(Relation onerel, BlockNumber blkno, Buffer buffer,
 	 * dirty, exclusively locked, and, if needed, a full page image has been
 	 * emitted in the log_heap_clean() above.
 	 */
-	if (heap_page_is_all_visible(onerel, buffer, &visibility_cutoff_xid))
+	if (heap_page_is_all_visible(onerel, buffer, &visibility_cutoff_xid,
+								 &all_frozen))
 		PageSetAllVisible(page);
 
 	/*
 	 * All the changes to the heap page have been done. If the all-visible
-	 * flag is now set, also set the VM bit.
+	 * flag is now set, also set the VM all-visible bit (and, if possible, the
+	 * all-frozen bit) unless this has already been done previously.
 	 */
-	if (PageIsAllVisible(page) &&
-		!visibilitymap_test(onerel, blkno, vmbuffer))
+	if (PageIsAllVisible(page))
 	{
+		uint8		vm_status = visibilitymap_get_status(onerel, blkno, vmbuffer);
+		uint8		flags = 0;
+
+		if ((vm_status & VISIBILITYMAP_ALL_VISIBLE) == 0)
+			flags |= VISIBILITYMAP_ALL_VISIBLE;
+		if ((vm_status & VISIBILITYMAP_ALL_FROZEN) == 0 && all_frozen)
+			flags |= VISIBILITYMAP_ALL_FROZEN;
+
 		Assert(BufferIsValid(*vmbuffer));
-		visibilitymap_set(onerel, blkno, buffer, InvalidXLogRecPtr, *vmbuffer,
-						  visibility_cutoff_xid);
+		if (flags != 0)
+			visibilitymap_set(onerel, blkno, buffer, InvalidXLogRecPtr,
+							  *vmbuffer, visibility_cutoff_xid,
+							  flags | VISIBILITYMAP_ALL_VISIBLE);
 	}
 
-	return tupindex;
+	return uncnt;
 }
 
 /*
@@ -1340,6 +1602,33 @@ lazy_check_needs_freeze(Buffer buf)
 }
 
 
+/*
+ *	lazy_vacuum_all_indexes() -- vacuum all indexes of a relation.
+ *
+ *		Delete the index entries pointing to the tuples listed in
+ *		vacrelstats->dead_tuples from every index, in parallel if
+ *		lazy_scan_heap decided it was worth it.
+ */
+static void
+lazy_vacuum_all_indexes(Relation onerel, Relation *Irel, int nindexes,
+						IndexBulkDeleteResult **indstats,
+						LVRelStats *vacrelstats)
+{
+	int			i;
+
+	if (vacrelstats->parallel_workers > 0)
+	{
+		lazy_parallel_vacuum_indexes(onerel, Irel, nindexes, indstats,
+									 vacrelstats);
+		return;
+	}
+
+	for (i = 0; i < nindexes; i++)
+		lazy_vacuum_index(Irel[i],
+						  &indstats[i],
+						  vacrelstats);
+}
+
 /*
  *	lazy_vacuum_index() -- vacuum one index relation.
  *
@@ -1368,9 +1657,9 @@ lazy_vacuum_index(Relation indrel,
 							   lazy_tid_reaped, (void *) vacrelstats);
 
 	ereport(elevel,
-			(errmsg("scanned index \"%s\" to remove %d row versions",
+			(errmsg("scanned index \"%s\" to remove %.0f row versions",
 					RelationGetRelationName(indrel),
-					vacrelstats->num_dead_tuples),
+					(double) vacrelstats->dead_tuples.num_tuples),
 			 errdetail("%s.", pg_rusage_show(&ru0))));
 }
 
@@ -1428,6 +1717,266 @@ lazy_cleanup_index(Relation indrel,
 	pfree(stats);
 }
 
+/*
+ *	lazy_parallel_degree() -- decide how many workers should help vacuum
+ *		the indexes of a relation, or 0 to vacuum them serially.
+ */
+static int
+lazy_parallel_degree(Relation onerel, Relation *Irel, int nindexes)
+{
+	int			nlarge = 0;
+	int			i;
+
+	if (max_parallel_maintenance_workers <= 0 || nindexes < 2)
+		return 0;
+
+	/*
+	 * Workers can't be started in a standalone backend or without dynamic
+	 * shared memory, and can't start workers of their own.  Workers also
+	 * need an active snapshot to be copied to them.
+	 */
+	if (!IsUnderPostmaster || dynamic_shared_memory_type == DSM_IMPL_NONE ||
+		IsInParallelMode() || !ActiveSnapshotSet())
+		return 0;
+
+	/*
+	 * Workers rely on the leader's locks, which is safe for user tables
+	 * only, and temporary tables live in the leader's local buffers.
+	 */
+	if (IsSystemRelation(onerel) || RelationUsesLocalBuffers(onerel))
+		return 0;
+
+	for (i = 0; i < nindexes; i++)
+	{
+		Oid			relam = Irel[i]->rd_rel->relam;
+
+		/*
+		 * The bulk-delete statistics of an index are passed back and forth
+		 * between passes through shared memory, so they must be a plain
+		 * IndexBulkDeleteResult, as they are for the built-in access
+		 * methods.
+		 */
+		if (relam != BTREE_AM_OID && relam != HASH_AM_OID &&
+			relam != GIST_AM_OID && relam != GIN_AM_OID &&
+			relam != SPGIST_AM_OID && relam != BRIN_AM_OID)
+			return 0;
+
+		if (RelationGetNumberOfBlocks(Irel[i]) >= PARALLEL_VACUUM_MIN_INDEX_PAGES)
+			nlarge++;
+	}
+
+	/* The leader vacuums one of the large indexes itself */
+	return Min(nlarge - 1, max_parallel_maintenance_workers);
+}
+
+/*
+ *	lazy_parallel_vacuum_indexes() -- vacuum all indexes of a relation,
+ *		with the help of background workers.
+ *
+ *		Fewer workers than planned may start, perhaps none, in which case
+ *		the leader simply does more of the work.
+ */
+static void
+lazy_parallel_vacuum_indexes(Relation onerel, Relation *Irel, int nindexes,
+							 IndexBulkDeleteResult **indstats,
+							 LVRelStats *vacrelstats)
+{
+	ParallelContext *pcxt;
+	LVShared   *lvshared;
+	LVDeadTuples *dead = &vacrelstats->dead_tuples;
+	char	   *deadspace;
+	Size		sharedsize;
+	Size		blocksize;
+	Size		wordsize;
+	int			i;
+
+	sharedsize = add_size(offsetof(LVShared, indexes),
+						  mul_size(sizeof(LVIndexSlot), nindexes));
+	blocksize = mul_size(sizeof(LVDeadBlock), dead->num_blocks);
+	wordsize = mul_size(sizeof(uint16), dead->num_words);
+
+	EnterParallelMode();
+	pcxt = CreateParallelContext(lazy_parallel_vacuum_main,
+								 vacrelstats->parallel_workers);
+
+	/* Estimate space for the shared state and the dead tuple TIDs */
+	shm_toc_estimate_chunk(&pcxt->estimator, sharedsize);
+	shm_toc_estimate_chunk(&pcxt->estimator, add_size(blocksize, wordsize));
+	shm_toc_estimate_keys(&pcxt->estimator, 2);
+
+	InitializeParallelDSM(pcxt);
+
+	/* Set up the shared state */
+	lvshared = (LVShared *) shm_toc_allocate(pcxt->toc, sharedsize);
+	lvshared->old_rel_tuples = vacrelstats->old_rel_tuples;
+	lvshared->num_dead_tuples = dead->num_tuples;
+	lvshared->num_dead_blocks = dead->num_blocks;
+	lvshared->num_dead_words = dead->num_words;
+	lvshared->elevel = elevel;
+	lvshared->cost_delay = VacuumCostDelay;
+	lvshared->cost_limit = VacuumCostLimit;
+	lvshared->nindexes = nindexes;
+	SpinLockInit(&lvshared->mutex);
+	lvshared->next_index = 0;
+	lvshared->page_hit = 0;
+	lvshared->page_miss = 0;
+	lvshared->page_dirty = 0;
+	for (i = 0; i < nindexes; i++)
+	{
+		LVIndexSlot *slot = &lvshared->indexes[i];
+
+		slot->indexrelid = RelationGetRelid(Irel[i]);
+		slot->has_stats = (indstats[i] != NULL);
+		if (indstats[i] != NULL)
+			slot->stats = *indstats[i];
+	}
+	shm_toc_insert(pcxt->toc, PARALLEL_KEY_VACUUM_SHARED, lvshared);
+
+	deadspace = shm_toc_allocate(pcxt->toc, add_size(blocksize, wordsize));
+	memcpy(deadspace, dead->blocks, blocksize);
+	memcpy(deadspace + blocksize, dead->words, wordsize);
+	shm_toc_insert(pcxt->toc, PARALLEL_KEY_DEAD_TUPLES, deadspace);
+
+	LaunchParallelWorkers(pcxt);
+
+	ereport(elevel,
+			(errmsg_plural("vacuuming indexes of \"%s\" with %d parallel worker",
+						   "vacuuming indexes of \"%s\" with %d parallel workers",
+						   pcxt->nworkers_launched,
+						   RelationGetRelationName(onerel),
+						   pcxt->nworkers_launched)));
+
+	/* Take our share of the indexes, then wait for the workers' */
+	lazy_parallel_vacuum_claim(lvshared, Irel, vacrelstats);
+	WaitForParallelWorkersToFinish(pcxt);
+
+	/* Collect the statistics to carry over to the next pass and cleanup */
+	for (i = 0; i < nindexes; i++)
+	{
+		LVIndexSlot *slot = &lvshared->indexes[i];
+
+		if (!slot->has_stats)
+			continue;
+		if (indstats[i] == NULL)
+			indstats[i] = (IndexBulkDeleteResult *)
+				palloc(sizeof(IndexBulkDeleteResult));
+		*indstats[i] = slot->stats;
+	}
+	VacuumPageHit += lvshared->page_hit;
+	VacuumPageMiss += lvshared->page_miss;
+	VacuumPageDirty += lvshared->page_dirty;
+
+	DestroyParallelContext(pcxt);
+	ExitParallelMode();
+}
+
+/*
+ *	lazy_parallel_vacuum_claim() -- claim indexes one at a time and vacuum
+ *		them, until none are left.  Run by the leader and by each worker.
+ */
+static void
+lazy_parallel_vacuum_claim(LVShared *lvshared, Relation *Irel,
+						   LVRelStats *vacrelstats)
+{
+	for (;;)
+	{
+		LVIndexSlot *slot;
+		IndexBulkDeleteResult *stats = NULL;
+		int			idx;
+
+		SpinLockAcquire(&lvshared->mutex);
+		idx = lvshared->next_index++;
+		SpinLockRelease(&lvshared->mutex);
+
+		if (idx >= lvshared->nindexes)
+			break;
+
+		slot = &lvshared->indexes[idx];
+		if (slot->has_stats)
+		{
+			stats = (IndexBulkDeleteResult *)
+				palloc(sizeof(IndexBulkDeleteResult));
+			*stats = slot->stats;
+		}
+
+		lazy_vacuum_index(Irel[idx], &stats, vacrelstats);
+
+		if (stats != NULL)
+		{
+			slot->stats = *stats;
+			slot->has_stats = true;
+			pfree(stats);
+		}
+	}
+}
+
+/*
+ *	lazy_parallel_vacuum_main() -- entry point of a parallel index vacuum
+ *		worker.
+ */
+static void
+lazy_parallel_vacuum_main(dsm_segment *seg, shm_toc *toc)
+{
+	LVShared   *lvshared;
+	char	   *deadspace;
+	LVRelStats	vacrelstats;
+	LVDeadTuples *dead = &vacrelstats.dead_tuples;
+	Relation   *Irel;
+	int			i;
+
+	lvshared = (LVShared *) shm_toc_lookup(toc, PARALLEL_KEY_VACUUM_SHARED);
+	deadspace = shm_toc_lookup(toc, PARALLEL_KEY_DEAD_TUPLES);
+	if (lvshared == NULL || deadspace == NULL)
+		elog(ERROR, "could not find parallel vacuum state");
+
+	/*
+	 * Only what lazy_vacuum_index and lazy_tid_reaped look at is needed; the
+	 * dead tuples are read in place, and never added to.
+	 */
+	memset(&vacrelstats, 0, sizeof(vacrelstats));
+	vacrelstats.old_rel_tuples = lvshared->old_rel_tuples;
+	dead->num_tuples = lvshared->num_dead_tuples;
+	dead->num_blocks = dead->max_blocks = lvshared->num_dead_blocks;
+	dead->num_words = dead->max_words = lvshared->num_dead_words;
+	dead->blocks = (LVDeadBlock *) deadspace;
+	dead->words = (uint16 *) (deadspace +
+							  sizeof(LVDeadBlock) * dead->num_blocks);
+
+	elevel = lvshared->elevel;
+	vac_strategy = GetAccessStrategy(BAS_VACUUM);
+
+	/*
+	 * Follow the leader's cost-based delay settings, which autovacuum
+	 * doesn't set through the GUC machinery.  Each participant keeps its own
+	 * balance, so the total I/O rate scales with the number of workers.
+	 */
+	VacuumCostDelay = lvshared->cost_delay;
+	VacuumCostLimit = lvshared->cost_limit;
+	VacuumCostActive = (VacuumCostDelay > 0);
+	VacuumCostBalance = 0;
+	VacuumPageHit = 0;
+	VacuumPageMiss = 0;
+	VacuumPageDirty = 0;
+
+	/* The leader holds the locks; see lazy_parallel_degree */
+	Irel = (Relation *) palloc(lvshared->nindexes * sizeof(Relation));
+	for (i = 0; i < lvshared->nindexes; i++)
+		Irel[i] = index_open(lvshared->indexes[i].indexrelid, NoLock);
+
+	lazy_parallel_vacuum_claim(lvshared, Irel, &vacrelstats);
+
+	for (i = 0; i < lvshared->nindexes; i++)
+		index_close(Irel[i], NoLock);
+
+	SpinLockAcquire(&lvshared->mutex);
+	lvshared->page_hit += VacuumPageHit;
+	lvshared->page_miss += VacuumPageMiss;
+	lvshared->page_dirty += VacuumPageDirty;
+	SpinLockRelease(&lvshared->mutex);
+
+	FreeAccessStrategy(vac_strategy);
+}
+
 /*
  * lazy_truncate_heap - try to truncate off any empty pages at the end
  */
@@ -1676,104 +2225,272 @@ count_nondeletable_pages(Relation onerel, LVRelStats *vacrelstats)
 static void
 lazy_space_alloc(LVRelStats *vacrelstats, BlockNumber relblocks)
 {
-	long		maxtuples;
+	LVDeadTuples *dead = &vacrelstats->dead_tuples;
 	int			vac_work_mem = IsAutoVacuumWorkerProcess() &&
 	autovacuum_work_mem != -1 ?
 	autovacuum_work_mem : maintenance_work_mem;
 
 	if (vacrelstats->hasindex)
 	{
-		maxtuples = (vac_work_mem * 1024L) / sizeof(ItemPointerData);
-		maxtuples = Min(maxtuples, INT_MAX);
-		maxtuples = Min(maxtuples, MaxAllocSize / sizeof(ItemPointerData));
-
-		/* curious coding here to ensure the multiplication can't overflow */
-		if ((BlockNumber) (maxtuples / LAZY_ALLOC_TUPLES) > relblocks)
-			maxtuples = relblocks * LAZY_ALLOC_TUPLES;
-
-		/* stay sane if small maintenance_work_mem */
-		maxtuples = Max(maxtuples, MaxHeapTuplesPerPage);
+		/* Start small; the arrays grow up to the memory limit as needed */
+		dead->max_bytes = (Size) vac_work_mem * 1024;
+		dead->max_blocks = Min(Max(relblocks, 1), 1024);
+		dead->max_words = dead->max_blocks * 4;
 	}
 	else
 	{
-		maxtuples = MaxHeapTuplesPerPage;
+		dead->max_blocks = 1;
+		dead->max_words = LV_DEAD_BLOCK_MAX_WORDS;
+		dead->max_bytes = 0;
 	}
 
-	vacrelstats->num_dead_tuples = 0;
-	vacrelstats->max_dead_tuples = (int) maxtuples;
-	vacrelstats->dead_tuples = (ItemPointer)
-		palloc(maxtuples * sizeof(ItemPointerData));
+	/* stay sane if small maintenance_work_mem */
+	dead->max_words = Max(dead->max_words, LV_DEAD_BLOCK_MAX_WORDS);
+	dead->max_bytes = Max(dead->max_bytes,
+						  dead->max_blocks * sizeof(LVDeadBlock) +
+						  dead->max_words * sizeof(uint16));
+
+	dead->num_tuples = 0;
+	dead->num_blocks = 0;
+	dead->num_words = 0;
+	dead->blocks = (LVDeadBlock *)
+		palloc(dead->max_blocks * sizeof(LVDeadBlock));
+	dead->words = (uint16 *) palloc(dead->max_words * sizeof(uint16));
 }
 
 /*
- * lazy_record_dead_tuple - remember one deletable tuple
+ * lazy_space_reserve - make room for one more block of dead tuples, taking
+ *		up to nwords words
+ *
+ * Returns false if that doesn't fit in the memory limit.
+ */
+static bool
+lazy_space_reserve(LVDeadTuples *dead, uint32 nwords)
+{
+	if (dead->num_blocks >= dead->max_blocks &&
+		!lazy_space_grow(dead, (void **) &dead->blocks, &dead->max_blocks,
+						 (uint64) dead->num_blocks + 1, sizeof(LVDeadBlock),
+						 (uint64) MaxBlockNumber + 1))
+		return false;
+
+	if ((uint64) dead->num_words + nwords > dead->max_words &&
+		!lazy_space_grow(dead, (void **) &dead->words, &dead->max_words,
+						 (uint64) dead->num_words + nwords, sizeof(uint16),
+						 (uint64) LV_DEAD_EXTERNAL - 1))
+		return false;
+
+	return true;
+}
+
+/*
+ * lazy_space_grow - enlarge one of the dead tuple arrays to at least needed
+ *		elements, and at most limit
+ *
+ * Arrays normally double in size, but near the memory limit they only take
+ * half of what is left each time, so one array can't starve the other.
+ * Returns false if needed elements won't fit.
+ */
+static bool
+lazy_space_grow(LVDeadTuples *dead, void **array, uint32 *maxelems,
+				uint64 needed, Size elemsize, uint64 limit)
+{
+	Size		allocated;
+	Size		spare;
+	uint64		newmax;
+
+	allocated = dead->max_blocks * sizeof(LVDeadBlock) +
+		dead->max_words * sizeof(uint16);
+	spare = (allocated < dead->max_bytes) ? dead->max_bytes - allocated : 0;
+
+	newmax = *maxelems + Min((uint64) *maxelems, (uint64) (spare / 2 / elemsize));
+	newmax = Max(newmax, needed);
+	newmax = Min(newmax, limit);
+	if (newmax < needed ||
+		(newmax - *maxelems) * elemsize > spare)
+		return false;
+
+	*array = repalloc_huge(*array, newmax * elemsize);
+	*maxelems = (uint32) newmax;
+	return true;
+}
+
+/*
+ * lazy_record_dead_tuples - remember the deletable tuples of one page
+ *
+ * Pages must be added in block number order, each with its offsets in
+ * ascending order.
  */
 static void
-lazy_record_dead_tuple(LVRelStats *vacrelstats,
-					   ItemPointer itemptr)
+lazy_record_dead_tuples(LVRelStats *vacrelstats, BlockNumber blkno,
+						OffsetNumber *offsets, int noffsets)
 {
+	LVDeadTuples *dead = &vacrelstats->dead_tuples;
+	LVDeadBlock *blk;
+	uint32		bitmapwords;
+	int			i;
+
+	Assert(noffsets > 0);
+	Assert(dead->num_blocks == 0 ||
+		   dead->blocks[dead->num_blocks - 1].blkno < blkno);
+
 	/*
-	 * The array shouldn't overflow under normal behavior, but perhaps it
-	 * could if we are given a really small maintenance_work_mem. In that
-	 * case, just forget the last few tuples (we'll get 'em next time).
+	 * lazy_scan_heap made sure there is room, but perhaps there isn't if we
+	 * are given a really small maintenance_work_mem.  In that case, just
+	 * forget this page's tuples (we'll get 'em next time).
 	 */
-	if (vacrelstats->num_dead_tuples < vacrelstats->max_dead_tuples)
+	if (!lazy_space_reserve(dead, LV_DEAD_BLOCK_MAX_WORDS))
+		return;
+
+	blk = &dead->blocks[dead->num_blocks++];
+	blk->blkno = blkno;
+	dead->num_tuples += noffsets;
+
+	if (noffsets <= 2)
 	{
-		vacrelstats->dead_tuples[vacrelstats->num_dead_tuples] = *itemptr;
-		vacrelstats->num_dead_tuples++;
+		blk->data = offsets[0];
+		if (noffsets == 2)
+			blk->data |= (uint32) offsets[1] << 16;
+		return;
+	}
+
+	blk->data = LV_DEAD_EXTERNAL | dead->num_words;
+	bitmapwords = (offsets[noffsets - 1] - FirstOffsetNumber) / 16 + 1;
+	if (bitmapwords < noffsets)
+	{
+		uint16	   *bitmap;
+
+		dead->words[dead->num_words++] = LV_DEAD_BITMAP | bitmapwords;
+		bitmap = &dead->words[dead->num_words];
+		memset(bitmap, 0, bitmapwords * sizeof(uint16));
+		for (i = 0; i < noffsets; i++)
+		{
+			uint32		bit = offsets[i] - FirstOffsetNumber;
+
+			bitmap[bit / 16] |= 1 << (bit % 16);
+		}
+		dead->num_words += bitmapwords;
+	}
+	else
+	{
+		dead->words[dead->num_words++] = noffsets;
+		for (i = 0; i < noffsets; i++)
+			dead->words[dead->num_words++] = offsets[i];
 	}
 }
 
 /*
- *	lazy_tid_reaped() -- is a particular tid deletable?
+ * lazy_dead_block_offsets - get the dead tuple offsets of one block
  *
- *		This has the right signature to be an IndexBulkDeleteCallback.
- *
- *		Assumes dead_tuples array is in sorted order.
+ * offsets must have room for MaxHeapTuplesPerPage entries.  Returns the
+ * number of offsets, which are in ascending order.
  */
-static bool
-lazy_tid_reaped(ItemPointer itemptr, void *state)
+static int
+lazy_dead_block_offsets(LVDeadTuples *dead, uint32 blkindex,
+						OffsetNumber *offsets)
 {
-	LVRelStats *vacrelstats = (LVRelStats *) state;
-	ItemPointer res;
+	uint32		data = dead->blocks[blkindex].data;
+	uint16	   *words;
+	uint16		header;
+	int			nwords;
+	int			n = 0;
+	int			i;
+
+	if ((data & LV_DEAD_EXTERNAL) == 0)
+	{
+		offsets[n++] = data & 0xFFFF;
+		if ((data >> 16) != 0)
+			offsets[n++] = data >> 16;
+		return n;
+	}
 
-	res = (ItemPointer) bsearch((void *) itemptr,
-								(void *) vacrelstats->dead_tuples,
-								vacrelstats->num_dead_tuples,
-								sizeof(ItemPointerData),
-								vac_cmp_itemptr);
+	words = &dead->words[data & ~LV_DEAD_EXTERNAL];
+	header = *words++;
+	nwords = header & LV_DEAD_NWORDS_MASK;
+	if ((header & LV_DEAD_BITMAP) == 0)
+	{
+		for (i = 0; i < nwords; i++)
+			offsets[n++] = words[i];
+		return n;
+	}
 
-	return (res != NULL);
+	for (i = 0; i < nwords * 16; i++)
+	{
+		if (words[i / 16] & (1 << (i % 16)))
+			offsets[n++] = i + FirstOffsetNumber;
+	}
+	return n;
 }
 
 /*
- * Comparator routines for use with qsort() and bsearch().
+ *	lazy_tid_reaped() -- is a particular tid deletable?
+ *
+ *		This has the right signature to be an IndexBulkDeleteCallback.
  */
-static int
-vac_cmp_itemptr(const void *left, const void *right)
+static bool
+lazy_tid_reaped(ItemPointer itemptr, void *state)
 {
-	BlockNumber lblk,
-				rblk;
-	OffsetNumber loff,
-				roff;
+	LVRelStats *vacrelstats = (LVRelStats *) state;
+	LVDeadTuples *dead = &vacrelstats->dead_tuples;
+	BlockNumber blkno = ItemPointerGetBlockNumber(itemptr);
+	OffsetNumber offnum = ItemPointerGetOffsetNumber(itemptr);
+	uint32		lo,
+				hi;
+	uint32		data;
+	uint16	   *words;
+	uint16		header;
+	int			nwords;
+
+	/* Find the block's entry */
+	if (dead->num_blocks == 0 ||
+		blkno < dead->blocks[0].blkno ||
+		blkno > dead->blocks[dead->num_blocks - 1].blkno)
+		return false;
+	lo = 0;
+	hi = dead->num_blocks;
+	while (lo < hi)
+	{
+		uint32		mid = lo + (hi - lo) / 2;
+
+		if (dead->blocks[mid].blkno < blkno)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (dead->blocks[lo].blkno != blkno)
+		return false;
 
-	lblk = ItemPointerGetBlockNumber((ItemPointer) left);
-	rblk = ItemPointerGetBlockNumber((ItemPointer) right);
+	/* And look for the offset in it */
+	data = dead->blocks[lo].data;
+	if ((data & LV_DEAD_EXTERNAL) == 0)
+		return offnum == (data & 0xFFFF) || offnum == (data >> 16);
 
-	if (lblk < rblk)
-		return -1;
-	if (lblk > rblk)
-		return 1;
+	words = &dead->words[data & ~LV_DEAD_EXTERNAL];
+	header = *words++;
+	nwords = header & LV_DEAD_NWORDS_MASK;
+	if (header & LV_DEAD_BITMAP)
+	{
+		uint32		bit = offnum - FirstOffsetNumber;
 
-	loff = ItemPointerGetOffsetNumber((ItemPointer) left);
-	roff = ItemPointerGetOffsetNumber((ItemPointer) right);
+		if (bit / 16 >= nwords)
+			return false;
+		return (words[bit / 16] & (1 << (bit % 16))) != 0;
+	}
+	else
+	{
+		int			l = 0,
+					h = nwords;
 
-	if (loff < roff)
-		return -1;
-	if (loff > roff)
-		return 1;
+		while (l < h)
+		{
+			int			m = (l + h) / 2;
 
-	return 0;
+			if (words[m] < offnum)
+				l = m + 1;
+			else
+				h = m;
+		}
+		return l < nwords && words[l] == offnum;
+	}
 }
 
 /*
@@ -1782,7 +2499,9 @@ vac_cmp_itemptr(const void *left, const void *right)
  * xmin amongst the visible tuples.
  */
 static bool
-heap_page_is_all_visible(Relation rel, Buffer buf, TransactionId *visibility_cutoff_xid)
+heap_page_is_all_visible(Relation rel, Buffer buf,
+						 TransactionId *visibility_cutoff_xid,
+						 bool *all_frozen)
 {
 	Page		page = BufferGetPage(buf);
 	BlockNumber blockno = BufferGetBlockNumber(buf);
@@ -1791,6 +2510,7 @@ heap_page_is_all_visible(Relation rel, Buffer buf, TransactionId *visibility_cut
 	bool		all_visible = true;
 
 	*visibility_cutoff_xid = InvalidTransactionId;
+	*all_frozen = true;
 
 	/*
 	 * This is a stripped down version of the line pointer scan in
@@ -1819,6 +2539,7 @@ heap_page_is_all_visible(Relation rel, Buffer buf, TransactionId *visibility_cut
 		if (ItemIdIsDead(itemid))
 		{
 			all_visible = false;
+			*all_frozen = false;
 			break;
 		}
 
@@ -1838,6 +2559,7 @@ heap_page_is_all_visible(Relation rel, Buffer buf, TransactionId *visibility_cut
 					if (!HeapTupleHeaderXminCommitted(tuple.t_data))
 					{
 						all_visible = false;
+						*all_frozen = false;
 						break;
 					}
 
@@ -1849,12 +2571,18 @@ heap_page_is_all_visible(Relation rel, Buffer buf, TransactionId *visibility_cut
 					if (!TransactionIdPrecedes(xmin, OldestXmin))
 					{
 						all_visible = false;
+						*all_frozen = false;
 						break;
 					}
 
 					/* Track newest xmin on page. */
 					if (TransactionIdFollows(xmin, *visibility_cutoff_xid))
 						*visibility_cutoff_xid = xmin;
+
+					/* Check whether this tuple is already frozen or not */
+					if (all_visible && *all_frozen &&
+						heap_tuple_needs_eventual_freeze(tuple.t_data))
+						*all_frozen = false;
 				}
 				break;
 
@@ -1863,6 +2591,7 @@ heap_page_is_all_visible(Relation rel, Buffer buf, TransactionId *visibility_cut
 			case HEAPTUPLE_INSERT_IN_PROGRESS:
 			case HEAPTUPLE_DELETE_IN_PROGRESS:
 				all_visible = false;
+				*all_frozen = false;
 				break;
 
 			default:
@@ -24,15 +24,18 @@
 #include "executor/nodeCustom.h"
 #include "executor/nodeForeignscan.h"
 #include "executor/nodeFunctionscan.h"
+#include "executor/nodeGather.h"
 #include "executor/nodeGroup.h"
 #include "executor/nodeGroup.h"
 #include "executor/nodeHash.h"
 #include "executor/nodeHashjoin.h"
+#include "executor/nodeIncrementalSort.h"
 #include "executor/nodeIndexonlyscan.h"
 #include "executor/nodeIndexscan.h"
 #include "executor/nodeLimit.h"
 #include "executor/nodeLockRows.h"
 #include "executor/nodeMaterial.h"
+#include "executor/nodeMemoize.h"
 #include "executor/nodeMergeAppend.h"
 #include "executor/nodeMergejoin.h"
 #include "executor/nodeModifyTable.h"
@@ -224,10 +227,18 @@ ExecReScan(PlanState *node)
 			ExecReScanMaterial((MaterialState *) node);
 			break;
 
+		case T_MemoizeState:
+			ExecReScanMemoize((MemoizeState *) node);
+			break;
+
 		case T_SortState:
 			ExecReScanSort((SortState *) node);
 			break;
 
+		case T_IncrementalSortState:
+			ExecReScanIncrementalSort((IncrementalSortState *) node);
+			break;
+
 		case T_GroupState:
 			ExecReScanGroup((GroupState *) node);
 			break;
@@ -244,6 +255,10 @@ ExecReScan(PlanState *node)
 			ExecReScanUnique((UniqueState *) node);
 			break;
 
+		case T_GatherState:
+			ExecReScanGather((GatherState *) node);
+			break;
+
 		case T_HashState:
 			ExecReScanHash((HashState *) node);
 			break;
@@ -549,6 +564,49 @@ IndexSupportsBackwardScan(Oid indexid)
 	return result;
 }
 
+/*
+ * ExecSupportsRerun - does a plan tree support being rerun by ExecutorRerun?
+ *
+ * ExecutorRerun restarts an already-started plan with ExecReScan after the
+ * values of its external Params have changed.  Nodes that cache their
+ * output or the state of a subplan across a rescan when none of their
+ * chgParam bits are set (Material, Sort, Agg and so on) would return stale
+ * rows, since changes of external Params are not signaled that way; so we
+ * accept only a small set of node types that re-evaluate everything on
+ * rescan.  InitPlans are rejected for the same reason, as are set-returning
+ * targetlists.  Scan nodes must be ones whose snapshot ExecutorRerun knows
+ * how to replace.
+ */
+bool
+ExecSupportsRerun(Plan *node)
+{
+	if (node == NULL)
+		return true;
+
+	if (node->initPlan != NIL ||
+		expression_returns_set((Node *) node->targetlist))
+		return false;
+
+	switch (nodeTag(node))
+	{
+		case T_Result:
+		case T_Limit:
+			return ExecSupportsRerun(outerPlan(node));
+
+		case T_NestLoop:
+			return ExecSupportsRerun(outerPlan(node)) &&
+				ExecSupportsRerun(innerPlan(node));
+
+		case T_SeqScan:
+		case T_IndexScan:
+		case T_IndexOnlyScan:
+			return true;
+
+		default:
+			return false;
+	}
+}
+
 /*
  * ExecMaterializesOutput - does a plan type materialize its output?
  *
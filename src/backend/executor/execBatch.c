@@ -0,0 +1,469 @@
+/*-------------------------------------------------------------------------
+ *
+ * execBatch.c
+ *	  Batch-at-a-time evaluation of simple scan quals.
+ *
+ * The general expression machinery in execQual.c evaluates each qual
+ * clause once per tuple, paying for an indirect call per expression node
+ * and a trip through the fmgr interface per operator.  For the most common
+ * kind of scan qual, a comparison between a fixed-width column and a
+ * constant, that overhead dwarfs the comparison itself.
+ *
+ * Here such clauses are instead evaluated over a batch of tuples at once:
+ * the referenced columns of every tuple in the batch are first extracted
+ * into plain C arrays, and then each clause is applied to a whole column
+ * in a single tight loop, the result being ANDed into a per-tuple pass
+ * array.  The loops are branch-free, so the compiler is free to vectorize
+ * them.  Finally the pass array is turned into a selection vector listing
+ * the tuples that satisfy all the batched clauses.
+ *
+ * Only strict comparison operators of int4, int8, float8, date, timestamp
+ * and timestamptz are handled; any other clause is left for the caller to
+ * evaluate a tuple at a time as usual.  Since the supported operators can
+ * neither fail nor have side effects, evaluating them ahead of the other
+ * clauses doesn't change the result.  It does change how many times the
+ * other clauses are evaluated, though, so a clause is only batched if none
+ * of the clauses before it that we leave alone calls volatile functions.
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * IDENTIFICATION
+ *	  src/backend/executor/execBatch.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <math.h>
+
+#include "catalog/pg_type.h"
+#include "executor/execBatch.h"
+#include "executor/executor.h"
+#include "optimizer/clauses.h"
+#include "optimizer/planmain.h"
+#include "utils/builtins.h"
+#include "utils/date.h"
+#include "utils/int8.h"
+#include "utils/timestamp.h"
+
+/*
+ * The operators we know how to evaluate.  We recognize them by the C
+ * function implementing them rather than by OID, so that timestamptz picks
+ * up the timestamp entries, which share their implementation.
+ */
+typedef struct BatchOperator
+{
+	Oid			typid;			/* input type of both arguments */
+	PGFunction	func;			/* implementation of the operator */
+	BatchValueType type;
+	BatchCompare cmp;
+} BatchOperator;
+
+static const BatchOperator batch_operators[] =
+{
+	{INT4OID, int4eq, BATCH_INT32, BATCH_EQ},
+	{INT4OID, int4ne, BATCH_INT32, BATCH_NE},
+	{INT4OID, int4lt, BATCH_INT32, BATCH_LT},
+	{INT4OID, int4le, BATCH_INT32, BATCH_LE},
+	{INT4OID, int4gt, BATCH_INT32, BATCH_GT},
+	{INT4OID, int4ge, BATCH_INT32, BATCH_GE},
+	{DATEOID, date_eq, BATCH_INT32, BATCH_EQ},
+	{DATEOID, date_ne, BATCH_INT32, BATCH_NE},
+	{DATEOID, date_lt, BATCH_INT32, BATCH_LT},
+	{DATEOID, date_le, BATCH_INT32, BATCH_LE},
+	{DATEOID, date_gt, BATCH_INT32, BATCH_GT},
+	{DATEOID, date_ge, BATCH_INT32, BATCH_GE},
+	{INT8OID, int8eq, BATCH_INT64, BATCH_EQ},
+	{INT8OID, int8ne, BATCH_INT64, BATCH_NE},
+	{INT8OID, int8lt, BATCH_INT64, BATCH_LT},
+	{INT8OID, int8le, BATCH_INT64, BATCH_LE},
+	{INT8OID, int8gt, BATCH_INT64, BATCH_GT},
+	{INT8OID, int8ge, BATCH_INT64, BATCH_GE},
+#ifdef HAVE_INT64_TIMESTAMP
+	{TIMESTAMPOID, timestamp_eq, BATCH_INT64, BATCH_EQ},
+	{TIMESTAMPOID, timestamp_ne, BATCH_INT64, BATCH_NE},
+	{TIMESTAMPOID, timestamp_lt, BATCH_INT64, BATCH_LT},
+	{TIMESTAMPOID, timestamp_le, BATCH_INT64, BATCH_LE},
+	{TIMESTAMPOID, timestamp_gt, BATCH_INT64, BATCH_GT},
+	{TIMESTAMPOID, timestamp_ge, BATCH_INT64, BATCH_GE},
+	{TIMESTAMPTZOID, timestamp_eq, BATCH_INT64, BATCH_EQ},
+	{TIMESTAMPTZOID, timestamp_ne, BATCH_INT64, BATCH_NE},
+	{TIMESTAMPTZOID, timestamp_lt, BATCH_INT64, BATCH_LT},
+	{TIMESTAMPTZOID, timestamp_le, BATCH_INT64, BATCH_LE},
+	{TIMESTAMPTZOID, timestamp_gt, BATCH_INT64, BATCH_GT},
+	{TIMESTAMPTZOID, timestamp_ge, BATCH_INT64, BATCH_GE},
+#endif
+	{FLOAT8OID, float8eq, BATCH_FLOAT8, BATCH_EQ},
+	{FLOAT8OID, float8ne, BATCH_FLOAT8, BATCH_NE},
+	{FLOAT8OID, float8lt, BATCH_FLOAT8, BATCH_LT},
+	{FLOAT8OID, float8le, BATCH_FLOAT8, BATCH_LE},
+	{FLOAT8OID, float8gt, BATCH_FLOAT8, BATCH_GT},
+	{FLOAT8OID, float8ge, BATCH_FLOAT8, BATCH_GE}
+};
+
+static bool batch_qual_clause(Expr *clause, Index scanrelid,
+				  AttrNumber *attno, BatchValueType *type,
+				  BatchCompare *cmp, Datum *constval);
+static BatchCompare batch_commute(BatchCompare cmp);
+
+
+/*
+ * ExecInitBatchQual
+ *
+ * Split the implicitly-ANDed qual list of a scan of relation scanrelid
+ * into the clauses we can evaluate in batches and the rest, which are
+ * returned in *residual.  Returns NULL, with *residual set to qual, if
+ * none of the clauses qualifies.
+ *
+ * capacity is the maximum number of tuples the caller will pass to
+ * ExecBatchQual at once.
+ */
+BatchQualState *
+ExecInitBatchQual(List *qual, Index scanrelid, int capacity,
+				  PlanState *parent, List **residual)
+{
+	BatchQualState *bqstate;
+	List	   *batched = NIL;
+	ListCell   *lc;
+	int			nclauses;
+	bool		volatile_residual = false;
+
+	*residual = NIL;
+	nclauses = list_length(qual);
+	bqstate = NULL;
+
+	foreach(lc, qual)
+	{
+		Expr	   *clause = (Expr *) lfirst(lc);
+		AttrNumber	attno;
+		BatchValueType type;
+		BatchCompare cmp;
+		Datum		constval;
+		BatchQualClause *bqclause;
+		int			col;
+
+		/*
+		 * Once a clause calling volatile functions is left for per-tuple
+		 * evaluation, the clauses after it must be too, so that it's still
+		 * called for the same tuples.
+		 */
+		if (volatile_residual ||
+			!batch_qual_clause(clause, scanrelid,
+							   &attno, &type, &cmp, &constval))
+		{
+			if (contain_volatile_functions((Node *) clause))
+				volatile_residual = true;
+			*residual = lappend(*residual, clause);
+			continue;
+		}
+
+		if (bqstate == NULL)
+		{
+			bqstate = (BatchQualState *) palloc0(sizeof(BatchQualState));
+			bqstate->capacity = capacity;
+			bqstate->columns = (BatchColumn *)
+				palloc(nclauses * sizeof(BatchColumn));
+			bqstate->clauses = (BatchQualClause *)
+				palloc(nclauses * sizeof(BatchQualClause));
+			bqstate->pass = (bool *) palloc(capacity * sizeof(bool));
+		}
+
+		/* Find or allocate the column holding attno */
+		for (col = 0; col < bqstate->ncolumns; col++)
+		{
+			if (bqstate->columns[col].attno == attno)
+				break;
+		}
+		if (col == bqstate->ncolumns)
+		{
+			BatchColumn *column = &bqstate->columns[col];
+
+			column->attno = attno;
+			column->type = type;
+			switch (type)
+			{
+				case BATCH_INT32:
+					column->values.i32 = (int32 *)
+						palloc(capacity * sizeof(int32));
+					break;
+				case BATCH_INT64:
+					column->values.i64 = (int64 *)
+						palloc(capacity * sizeof(int64));
+					break;
+				case BATCH_FLOAT8:
+					column->values.f8 = (float8 *)
+						palloc(capacity * sizeof(float8));
+					break;
+			}
+			bqstate->ncolumns++;
+			bqstate->maxattno = Max(bqstate->maxattno, attno);
+		}
+		Assert(bqstate->columns[col].type == type);
+
+		bqclause = &bqstate->clauses[bqstate->nclauses++];
+		bqclause->column = col;
+		bqclause->cmp = cmp;
+		bqclause->intval = 0;
+		bqclause->floatval = 0;
+		switch (type)
+		{
+			case BATCH_INT32:
+				bqclause->intval = DatumGetInt32(constval);
+				break;
+			case BATCH_INT64:
+				bqclause->intval = DatumGetInt64(constval);
+				break;
+			case BATCH_FLOAT8:
+				bqclause->floatval = DatumGetFloat8(constval);
+				break;
+		}
+
+		batched = lappend(batched, clause);
+	}
+
+	if (bqstate != NULL)
+		bqstate->tupleQual = (List *) ExecInitExpr((Expr *) batched, parent);
+
+	return bqstate;
+}
+
+/*
+ * batch_qual_clause
+ *
+ * Is this clause a "column op constant" comparison we can batch?  If so,
+ * fill in the output arguments, with the operator commuted if necessary
+ * so that the column is its left input.
+ */
+static bool
+batch_qual_clause(Expr *clause, Index scanrelid,
+				  AttrNumber *attno, BatchValueType *type,
+				  BatchCompare *cmp, Datum *constval)
+{
+	OpExpr	   *opexpr;
+	Node	   *leftop;
+	Node	   *rightop;
+	Var		   *var;
+	Const	   *con;
+	bool		commuted;
+	FmgrInfo	flinfo;
+	int			i;
+
+	if (!IsA(clause, OpExpr))
+		return false;
+	opexpr = (OpExpr *) clause;
+	if (opexpr->opretset || list_length(opexpr->args) != 2)
+		return false;
+
+	leftop = (Node *) linitial(opexpr->args);
+	rightop = (Node *) lsecond(opexpr->args);
+	if (IsA(leftop, Var) && IsA(rightop, Const))
+	{
+		var = (Var *) leftop;
+		con = (Const *) rightop;
+		commuted = false;
+	}
+	else if (IsA(leftop, Const) && IsA(rightop, Var))
+	{
+		var = (Var *) rightop;
+		con = (Const *) leftop;
+		commuted = true;
+	}
+	else
+		return false;
+
+	if (var->varno != scanrelid || var->varlevelsup != 0 ||
+		var->varattno <= 0)
+		return false;
+	if (con->constisnull || con->consttype != var->vartype)
+		return false;
+
+	set_opfuncid(opexpr);
+	fmgr_info(opexpr->opfuncid, &flinfo);
+
+	for (i = 0; i < lengthof(batch_operators); i++)
+	{
+		const BatchOperator *bop = &batch_operators[i];
+
+		if (bop->typid != var->vartype || bop->func != flinfo.fn_addr)
+			continue;
+
+		/*
+		 * float8 comparisons treat NaN as equal to itself and greater than
+		 * anything else.  The loops in ExecBatchQual get that right for a
+		 * NaN column value, but not for a NaN constant; leave those alone.
+		 */
+		if (bop->type == BATCH_FLOAT8 && isnan(DatumGetFloat8(con->constvalue)))
+			return false;
+
+		*attno = var->varattno;
+		*type = bop->type;
+		*cmp = commuted ? batch_commute(bop->cmp) : bop->cmp;
+		*constval = con->constvalue;
+		return true;
+	}
+
+	return false;
+}
+
+static BatchCompare
+batch_commute(BatchCompare cmp)
+{
+	switch (cmp)
+	{
+		case BATCH_LT:
+			return BATCH_GT;
+		case BATCH_LE:
+			return BATCH_GE;
+		case BATCH_GT:
+			return BATCH_LT;
+		case BATCH_GE:
+			return BATCH_LE;
+		default:
+			return cmp;
+	}
+}
+
+/*
+ * Apply "values[i] cmp c" to the whole batch.
+ *
+ * GT and GE are written as the negation of LE and LT, which is the same
+ * thing for integers, but for float8 also makes a NaN column value compare
+ * greater than the constant, following float8_cmp_internal.  NaN != c is
+ * already true, and EQ, LT and LE are already false, as they should be.
+ */
+#define BATCH_COMPARE_LOOP(values, c, cmp, pass, n) \
+	do { \
+		int			i_; \
+		switch (cmp) \
+		{ \
+			case BATCH_EQ: \
+				for (i_ = 0; i_ < (n); i_++) \
+					(pass)[i_] &= ((values)[i_] == (c)); \
+				break; \
+			case BATCH_NE: \
+				for (i_ = 0; i_ < (n); i_++) \
+					(pass)[i_] &= ((values)[i_] != (c)); \
+				break; \
+			case BATCH_LT: \
+				for (i_ = 0; i_ < (n); i_++) \
+					(pass)[i_] &= ((values)[i_] < (c)); \
+				break; \
+			case BATCH_LE: \
+				for (i_ = 0; i_ < (n); i_++) \
+					(pass)[i_] &= ((values)[i_] <= (c)); \
+				break; \
+			case BATCH_GT: \
+				for (i_ = 0; i_ < (n); i_++) \
+					(pass)[i_] &= !((values)[i_] <= (c)); \
+				break; \
+			case BATCH_GE: \
+				for (i_ = 0; i_ < (n); i_++) \
+					(pass)[i_] &= !((values)[i_] < (c)); \
+				break; \
+		} \
+	} while (0)
+
+/*
+ * ExecBatchQual
+ *
+ * Evaluate the batched clauses over ntuples tuples, which must be no more
+ * than the capacity given to ExecInitBatchQual.  The indexes of the tuples
+ * satisfying all of them are stored into sel, in ascending order, and their
+ * number is returned.
+ *
+ * slot is a work slot with the scanned relation's descriptor, used to
+ * deform the tuples; it is left empty.
+ */
+int
+ExecBatchQual(BatchQualState *bqstate, HeapTupleData *tuples, int ntuples,
+			  TupleTableSlot *slot, int *sel)
+{
+	bool	   *pass = bqstate->pass;
+	int			nsel;
+	int			i;
+	int			j;
+
+	Assert(ntuples <= bqstate->capacity);
+
+	/*
+	 * Extract the referenced columns.  A null rejects the tuple outright,
+	 * since all the operators are strict.
+	 */
+	for (i = 0; i < ntuples; i++)
+	{
+		ExecStoreTuple(&tuples[i], slot, InvalidBuffer, false);
+		slot_getsomeattrs(slot, bqstate->maxattno);
+
+		pass[i] = true;
+		for (j = 0; j < bqstate->ncolumns; j++)
+		{
+			BatchColumn *column = &bqstate->columns[j];
+			int			off = column->attno - 1;
+			bool		isnull = slot->tts_isnull[off];
+			Datum		value = slot->tts_values[off];
+
+			if (isnull)
+				pass[i] = false;
+
+			switch (column->type)
+			{
+				case BATCH_INT32:
+					column->values.i32[i] = isnull ? 0 : DatumGetInt32(value);
+					break;
+				case BATCH_INT64:
+					column->values.i64[i] = isnull ? 0 : DatumGetInt64(value);
+					break;
+				case BATCH_FLOAT8:
+					column->values.f8[i] = isnull ? 0 : DatumGetFloat8(value);
+					break;
+			}
+		}
+	}
+	ExecClearTuple(slot);
+
+	/* Apply each clause to its whole column */
+	for (j = 0; j < bqstate->nclauses; j++)
+	{
+		BatchQualClause *clause = &bqstate->clauses[j];
+		BatchColumn *column = &bqstate->columns[clause->column];
+
+		switch (column->type)
+		{
+			case BATCH_INT32:
+				{
+					const int32 *values = column->values.i32;
+					int32		c = (int32) clause->intval;
+
+					BATCH_COMPARE_LOOP(values, c, clause->cmp, pass, ntuples);
+				}
+				break;
+			case BATCH_INT64:
+				{
+					const int64 *values = column->values.i64;
+					int64		c = clause->intval;
+
+					BATCH_COMPARE_LOOP(values, c, clause->cmp, pass, ntuples);
+				}
+				break;
+			case BATCH_FLOAT8:
+				{
+					const float8 *values = column->values.f8;
+					float8		c = clause->floatval;
+
+					BATCH_COMPARE_LOOP(values, c, clause->cmp, pass, ntuples);
+				}
+				break;
+		}
+	}
+
+	/* Build the selection vector, again without branches */
+	nsel = 0;
+	for (i = 0; i < ntuples; i++)
+	{
+		sel[nsel] = i;
+		nsel += pass[i] ? 1 : 0;
+	}
+
+	return nsel;
+}
@@ -18,17 +18,35 @@
  */
 #include "postgres.h"
 
+#include "access/hash.h"
 #include "executor/executor.h"
 #include "miscadmin.h"
+#include "utils/fmgroids.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 
 
-static TupleHashTable CurTupleHashTable = NULL;
+static uint32 TupleHashTableHash(struct tuplehash_hash *tb,
+				   const MinimalTuple tuple);
+static int TupleHashTableMatch(struct tuplehash_hash *tb,
+					const MinimalTuple tuple1, const MinimalTuple tuple2);
 
-static uint32 TupleHashTableHash(const void *key, Size keysize);
-static int TupleHashTableMatch(const void *key1, const void *key2,
-					Size keysize);
+/*
+ * Define parameters for tuple hash table code generation.  The interface is
+ * *also* declared in execnodes.h (to generate the types, which are
+ * externally visible).
+ */
+#define SH_PREFIX tuplehash
+#define SH_ELEMENT_TYPE TupleHashBucketData
+#define SH_KEY_TYPE MinimalTuple
+#define SH_KEY firstTuple
+#define SH_HASH_KEY(tb, key) TupleHashTableHash(tb, key)
+#define SH_EQUAL(tb, a, b) (TupleHashTableMatch(tb, a, b) == 0)
+#define SH_SCOPE extern
+#define SH_STORE_HASH
+#define SH_GET_HASH(tb, a) a->hash
+#define SH_DEFINE
+#include "lib/simplehash.h"
 
 
 /*****************************************************************************
@@ -204,6 +222,36 @@ execTuplesMatchPrepare(int numCols,
 	return eqFunctions;
 }
 
+/*
+ * execHashFunctionInfo
+ *		Set up an FmgrInfo for calling a hash function, for a hash table that
+ *		lives only in memory (or in temp files) during one query.
+ *
+ * The hash functions in the catalogs have to keep giving the same results,
+ * since hash indexes store them.  For some common ones we substitute a
+ * faster function here that has no such promise.  When values of two
+ * different datatypes are hashed into the same table, the caller must use
+ * this only if both use the same catalog hash function, so that both are
+ * substituted alike.
+ */
+void
+execHashFunctionInfo(Oid hashfn, FmgrInfo *finfo)
+{
+	fmgr_info(hashfn, finfo);
+
+	switch (hashfn)
+	{
+		case F_HASHTEXT:
+			finfo->fn_addr = hashtext_fast;
+			break;
+		case F_HASHVARLENA:
+			finfo->fn_addr = hashvarlena_fast;
+			break;
+		default:
+			break;
+	}
+}
+
 /*
  * execTuplesHashPrepare
  *		Look up the equality and hashing functions needed for a TupleHashTable.
@@ -240,7 +288,7 @@ execTuplesHashPrepare(int numCols,
 		/* We're not supporting cross-type cases here */
 		Assert(left_hash_function == right_hash_function);
 		fmgr_info(eq_function, &(*eqFunctions)[i]);
-		fmgr_info(right_hash_function, &(*hashFunctions)[i]);
+		execHashFunctionInfo(right_hash_function, &(*hashFunctions)[i]);
 	}
 }
 
@@ -279,7 +327,6 @@ BuildTupleHashTable(int numCols, AttrNumber *keyColIdx,
 					MemoryContext tablecxt, MemoryContext tempcxt)
 {
 	TupleHashTable hashtable;
-	HASHCTL		hash_ctl;
 
 	Assert(nbuckets > 0);
 	Assert(entrysize >= sizeof(TupleHashEntryData));
@@ -302,15 +349,7 @@ BuildTupleHashTable(int numCols, AttrNumber *keyColIdx,
 	hashtable->in_hash_funcs = NULL;
 	hashtable->cur_eq_funcs = NULL;
 
-	MemSet(&hash_ctl, 0, sizeof(hash_ctl));
-	hash_ctl.keysize = sizeof(TupleHashEntryData);
-	hash_ctl.entrysize = entrysize;
-	hash_ctl.hash = TupleHashTableHash;
-	hash_ctl.match = TupleHashTableMatch;
-	hash_ctl.hcxt = tablecxt;
-	hashtable->hashtab = hash_create("TupleHashTable", nbuckets,
-									 &hash_ctl,
-					HASH_ELEM | HASH_FUNCTION | HASH_COMPARE | HASH_CONTEXT);
+	hashtable->hashtab = tuplehash_create(tablecxt, nbuckets, hashtable);
 
 	return hashtable;
 }
@@ -332,9 +371,9 @@ LookupTupleHashEntry(TupleHashTable hashtable, TupleTableSlot *slot,
 					 bool *isnew)
 {
 	TupleHashEntry entry;
+	TupleHashBucketData *bucket;
 	MemoryContext oldContext;
-	TupleHashTable saveCurHT;
-	TupleHashEntryData dummy;
+	uint32		hash;
 	bool		found;
 
 	/* If first time through, clone the input slot to make table slot */
@@ -356,53 +395,45 @@ LookupTupleHashEntry(TupleHashTable hashtable, TupleTableSlot *slot,
 	/* Need to run the hash functions in short-lived context */
 	oldContext = MemoryContextSwitchTo(hashtable->tempcxt);
 
-	/*
-	 * Set up data needed by hash and match functions
-	 *
-	 * We save and restore CurTupleHashTable just in case someone manages to
-	 * invoke this code re-entrantly.
-	 */
+	/* Set up data needed by hash and match functions */
 	hashtable->inputslot = slot;
 	hashtable->in_hash_funcs = hashtable->tab_hash_funcs;
 	hashtable->cur_eq_funcs = hashtable->tab_eq_funcs;
 
-	saveCurHT = CurTupleHashTable;
-	CurTupleHashTable = hashtable;
-
-	/* Search the hash table */
-	dummy.firstTuple = NULL;	/* flag to reference inputslot */
-	entry = (TupleHashEntry) hash_search(hashtable->hashtab,
-										 &dummy,
-										 isnew ? HASH_ENTER : HASH_FIND,
-										 &found);
+	/* A NULL key tells the hash and match functions to use inputslot */
+	hash = TupleHashTableHash(hashtable->hashtab, NULL);
 
 	if (isnew)
 	{
+		bucket = tuplehash_insert_hash(hashtable->hashtab, NULL, hash,
+									   &found);
+
 		if (found)
 		{
 			/* found pre-existing entry */
+			entry = bucket->entry;
 			*isnew = false;
 		}
 		else
 		{
 			/*
-			 * created new entry
-			 *
-			 * Zero any caller-requested space in the entry.  (This zaps the
-			 * "key data" dynahash.c copied into the new entry, but we don't
-			 * care since we're about to overwrite it anyway.)
+			 * created new bucket; make the entry to go with it, and copy
+			 * the first tuple into the table context
 			 */
-			MemSet(entry, 0, hashtable->entrysize);
-
-			/* Copy the first tuple into the table context */
 			MemoryContextSwitchTo(hashtable->tablecxt);
+			entry = (TupleHashEntry) palloc0(hashtable->entrysize);
 			entry->firstTuple = ExecCopySlotMinimalTuple(slot);
+			bucket->firstTuple = entry->firstTuple;
+			bucket->entry = entry;
 
 			*isnew = true;
 		}
 	}
-
-	CurTupleHashTable = saveCurHT;
+	else
+	{
+		bucket = tuplehash_lookup_hash(hashtable->hashtab, NULL, hash);
+		entry = bucket ? bucket->entry : NULL;
+	}
 
 	MemoryContextSwitchTo(oldContext);
 
@@ -423,63 +454,93 @@ FindTupleHashEntry(TupleHashTable hashtable, TupleTableSlot *slot,
 				   FmgrInfo *eqfunctions,
 				   FmgrInfo *hashfunctions)
 {
-	TupleHashEntry entry;
+	TupleHashBucketData *bucket;
 	MemoryContext oldContext;
-	TupleHashTable saveCurHT;
-	TupleHashEntryData dummy;
+	uint32		hash;
 
 	/* Need to run the hash functions in short-lived context */
 	oldContext = MemoryContextSwitchTo(hashtable->tempcxt);
 
-	/*
-	 * Set up data needed by hash and match functions
-	 *
-	 * We save and restore CurTupleHashTable just in case someone manages to
-	 * invoke this code re-entrantly.
-	 */
+	/* Set up data needed by hash and match functions */
 	hashtable->inputslot = slot;
 	hashtable->in_hash_funcs = hashfunctions;
 	hashtable->cur_eq_funcs = eqfunctions;
 
-	saveCurHT = CurTupleHashTable;
-	CurTupleHashTable = hashtable;
-
 	/* Search the hash table */
-	dummy.firstTuple = NULL;	/* flag to reference inputslot */
-	entry = (TupleHashEntry) hash_search(hashtable->hashtab,
-										 &dummy,
-										 HASH_FIND,
-										 NULL);
+	hash = TupleHashTableHash(hashtable->hashtab, NULL);
+	bucket = tuplehash_lookup_hash(hashtable->hashtab, NULL, hash);
+
+	MemoryContextSwitchTo(oldContext);
+
+	return bucket ? bucket->entry : NULL;
+}
+
+/*
+ * Remove the hashtable entry matching the given tuple, if there is one.
+ * The entry's firstTuple is not freed; the caller should do that if it's
+ * no longer needed.  The slot must not be the table's own tableslot, so to
+ * remove an entry given its firstTuple, store that in a slot of the
+ * caller's first.
+ */
+void
+RemoveTupleHashEntry(TupleHashTable hashtable, TupleTableSlot *slot)
+{
+	TupleHashBucketData *bucket;
+	MemoryContext oldContext;
+	uint32		hash;
+
+	/* Need to run the hash functions in short-lived context */
+	oldContext = MemoryContextSwitchTo(hashtable->tempcxt);
+
+	/* Set up data needed by hash and match functions, as above */
+	hashtable->inputslot = slot;
+	hashtable->in_hash_funcs = hashtable->tab_hash_funcs;
+	hashtable->cur_eq_funcs = hashtable->tab_eq_funcs;
 
-	CurTupleHashTable = saveCurHT;
+	hash = TupleHashTableHash(hashtable->hashtab, NULL);
+	bucket = tuplehash_lookup_hash(hashtable->hashtab, NULL, hash);
 
 	MemoryContextSwitchTo(oldContext);
 
-	return entry;
+	if (bucket)
+	{
+		pfree(bucket->entry);
+		tuplehash_delete_item(hashtable->hashtab, bucket);
+	}
+}
+
+/*
+ * Return the next entry of a scan started with InitTupleHashIterator,
+ * or NULL if there are no more.
+ */
+TupleHashEntry
+ScanTupleHashTable(TupleHashTable hashtable, TupleHashIterator *iter)
+{
+	TupleHashBucketData *bucket;
+
+	bucket = tuplehash_iterate(hashtable->hashtab, iter);
+
+	return bucket ? bucket->entry : NULL;
 }
 
 /*
  * Compute the hash value for a tuple
  *
- * The passed-in key is a pointer to TupleHashEntryData.  In an actual hash
- * table entry, the firstTuple field points to a tuple (in MinimalTuple
- * format).  LookupTupleHashEntry sets up a dummy TupleHashEntryData with a
- * NULL firstTuple field --- that cues us to look at the inputslot instead.
- * This convention avoids the need to materialize virtual input tuples unless
- * they actually need to get copied into the table.
- *
- * CurTupleHashTable must be set before calling this, since dynahash.c
- * doesn't provide any API that would let us get at the hashtable otherwise.
+ * The passed-in key is a MinimalTuple stored in the table, or NULL; the
+ * callers above pass NULL to cue us to look at the inputslot instead.  This
+ * convention avoids the need to materialize virtual input tuples unless
+ * they actually need to get copied into the table.  (As the hash values of
+ * the stored tuples are kept in the buckets, the other case doesn't
+ * actually occur in the current simplehash.h code.)
  *
  * Also, the caller must select an appropriate memory context for running
- * the hash functions. (dynahash.c doesn't change CurrentMemoryContext.)
+ * the hash functions.
  */
 static uint32
-TupleHashTableHash(const void *key, Size keysize)
+TupleHashTableHash(struct tuplehash_hash *tb, const MinimalTuple tuple)
 {
-	MinimalTuple tuple = ((const TupleHashEntryData *) key)->firstTuple;
+	TupleHashTable hashtable = (TupleHashTable) tb->private_data;
 	TupleTableSlot *slot;
-	TupleHashTable hashtable = CurTupleHashTable;
 	int			numCols = hashtable->numCols;
 	AttrNumber *keyColIdx = hashtable->keyColIdx;
 	FmgrInfo   *hashfunctions;
@@ -495,7 +556,6 @@ TupleHashTableHash(const void *key, Size keysize)
 	else
 	{
 		/* Process a tuple already stored in the table */
-		/* (this case never actually occurs in current dynahash.c code) */
 		slot = hashtable->tableslot;
 		ExecStoreMinimalTuple(tuple, slot, false);
 		hashfunctions = hashtable->tab_hash_funcs;
@@ -528,31 +588,25 @@ TupleHashTableHash(const void *key, Size keysize)
 /*
  * See whether two tuples (presumably of the same hash value) match
  *
- * As above, the passed pointers are pointers to TupleHashEntryData.
- *
- * CurTupleHashTable must be set before calling this, since dynahash.c
- * doesn't provide any API that would let us get at the hashtable otherwise.
+ * The first argument is a tuple stored in the table, the second the NULL
+ * key standing for the inputslot, as above.
  *
  * Also, the caller must select an appropriate memory context for running
- * the compare functions.  (dynahash.c doesn't change CurrentMemoryContext.)
+ * the compare functions.
  */
 static int
-TupleHashTableMatch(const void *key1, const void *key2, Size keysize)
+TupleHashTableMatch(struct tuplehash_hash *tb, const MinimalTuple tuple1,
+					const MinimalTuple tuple2)
 {
-	MinimalTuple tuple1 = ((const TupleHashEntryData *) key1)->firstTuple;
-
-#ifdef USE_ASSERT_CHECKING
-	MinimalTuple tuple2 = ((const TupleHashEntryData *) key2)->firstTuple;
-#endif
 	TupleTableSlot *slot1;
 	TupleTableSlot *slot2;
-	TupleHashTable hashtable = CurTupleHashTable;
+	TupleHashTable hashtable = (TupleHashTable) tb->private_data;
 
 	/*
-	 * We assume that dynahash.c will only ever call us with the first
+	 * We assume that simplehash.h will only ever call us with the first
 	 * argument being an actual table entry, and the second argument being
-	 * LookupTupleHashEntry's dummy TupleHashEntryData.  The other direction
-	 * could be supported too, but is not currently used by dynahash.c.
+	 * the NULL key of the callers above.  The other direction could be
+	 * supported too, but is not currently required.
 	 */
 	Assert(tuple1 != NULL);
 	slot1 = hashtable->tableslot;
@@ -38,6 +38,7 @@
 #include "postgres.h"
 
 #include "access/htup_details.h"
+#include "access/relscan.h"
 #include "access/sysattr.h"
 #include "access/transam.h"
 #include "access/xact.h"
@@ -71,11 +72,13 @@ ExecutorEnd_hook_type ExecutorEnd_hook = NULL;
 ExecutorCheckPerms_hook_type ExecutorCheckPerms_hook = NULL;
 
 /* decls for local routines only used within this module */
+static void ExecSetScanSnapshot(PlanState *planstate, Snapshot snapshot);
 static void InitPlan(QueryDesc *queryDesc, int eflags);
 static void CheckValidRowMarkRel(Relation rel, RowMarkType markType);
 static void ExecPostprocessPlan(EState *estate);
 static void ExecEndPlan(PlanState *planstate, EState *estate);
 static void ExecutePlan(EState *estate, PlanState *planstate,
+			bool use_parallel_mode,
 			CmdType operation,
 			bool sendTuples,
 			long numberTuples,
@@ -101,9 +104,9 @@ static void EvalPlanQualStart(EPQState *epqstate, EState *parentestate,
  * to be changed, however.
  */
 #define GetInsertedColumns(relinfo, estate) \
-	(rt_fetch((relinfo)->ri_RangeTableIndex, (estate)->es_range_table)->insertedCols)
+	(exec_rt_fetch((relinfo)->ri_RangeTableIndex, estate)->insertedCols)
 #define GetUpdatedColumns(relinfo, estate) \
-	(rt_fetch((relinfo)->ri_RangeTableIndex, (estate)->es_range_table)->updatedCols)
+	(exec_rt_fetch((relinfo)->ri_RangeTableIndex, estate)->updatedCols)
 
 /* end of local decls */
 
@@ -336,6 +339,7 @@ standard_ExecutorRun(QueryDesc *queryDesc,
 	if (!ScanDirectionIsNoMovement(direction))
 		ExecutePlan(estate,
 					queryDesc->planstate,
+					queryDesc->plannedstmt->parallelModeNeeded,
 					operation,
 					sendTuples,
 					count,
@@ -523,6 +527,116 @@ ExecutorRewind(QueryDesc *queryDesc)
 	MemoryContextSwitchTo(oldcontext);
 }
 
+/* ----------------------------------------------------------------
+ *		ExecutorRerun
+ *
+ *		This routine may be called on an open queryDesc, between
+ *		ExecutorRun calls, to run it again from the start under a new
+ *		snapshot, picking up new values of its external Params.  This
+ *		saves the executor startup and shutdown of a query that is
+ *		executed repeatedly.  The caller must have checked the plan with
+ *		ExecSupportsRerun, and is responsible for checking that nothing
+ *		else about the query's environment has changed (the plan is still
+ *		valid, the current user is the same, and so on).
+ * ----------------------------------------------------------------
+ */
+void
+ExecutorRerun(QueryDesc *queryDesc, Snapshot snapshot)
+{
+	EState	   *estate;
+	Snapshot	old_es_snapshot;
+	Snapshot	old_snapshot;
+	MemoryContext oldcontext;
+
+	/* sanity checks */
+	Assert(queryDesc != NULL);
+
+	estate = queryDesc->estate;
+
+	Assert(estate != NULL);
+	Assert(queryDesc->operation == CMD_SELECT);
+	Assert(!estate->es_finished);
+
+	/*
+	 * Switch the query over to the new snapshot.  Register it before
+	 * releasing the old ones, in case they are the same.
+	 */
+	old_es_snapshot = estate->es_snapshot;
+	old_snapshot = queryDesc->snapshot;
+	estate->es_snapshot = RegisterSnapshot(snapshot);
+	queryDesc->snapshot = RegisterSnapshot(snapshot);
+	ExecSetScanSnapshot(queryDesc->planstate, estate->es_snapshot);
+	UnregisterSnapshot(old_es_snapshot);
+	UnregisterSnapshot(old_snapshot);
+
+	/*
+	 * Switch into per-query memory context
+	 */
+	oldcontext = MemoryContextSwitchTo(estate->es_query_cxt);
+
+	estate->es_processed = 0;
+	estate->es_lastoid = InvalidOid;
+
+	/*
+	 * rescan plan
+	 */
+	ExecReScan(queryDesc->planstate);
+
+	MemoryContextSwitchTo(oldcontext);
+}
+
+/*
+ * ExecSetScanSnapshot
+ *		Make the scans of a plan tree accepted by ExecSupportsRerun use
+ *		the given snapshot from their next rescan on.
+ */
+static void
+ExecSetScanSnapshot(PlanState *planstate, Snapshot snapshot)
+{
+	if (planstate == NULL)
+		return;
+
+	switch (nodeTag(planstate))
+	{
+		case T_SeqScanState:
+			{
+				HeapScanDesc scan = ((ScanState *) planstate)->ss_currentScanDesc;
+
+				if (scan != NULL)
+					scan->rs_snapshot = snapshot;
+			}
+			break;
+
+		case T_IndexScanState:
+			{
+				IndexScanDesc scan;
+
+				scan = ((IndexScanState *) planstate)->iss_ScanDesc;
+
+				if (scan != NULL)
+					scan->xs_snapshot = snapshot;
+			}
+			break;
+
+		case T_IndexOnlyScanState:
+			{
+				IndexScanDesc scan;
+
+				scan = ((IndexOnlyScanState *) planstate)->ioss_ScanDesc;
+
+				if (scan != NULL)
+					scan->xs_snapshot = snapshot;
+			}
+			break;
+
+		default:
+			break;
+	}
+
+	ExecSetScanSnapshot(outerPlanState(planstate), snapshot);
+	ExecSetScanSnapshot(innerPlanState(planstate), snapshot);
+}
+
 
 /*
  * ExecCheckRTPerms
@@ -793,7 +907,7 @@ InitPlan(QueryDesc *queryDesc, int eflags)
 	/*
 	 * initialize the node's execution state
 	 */
-	estate->es_range_table = rangeTable;
+	ExecInitRangeTable(estate, rangeTable);
 	estate->es_plannedstmt = plannedstmt;
 
 	/*
@@ -818,7 +932,7 @@ InitPlan(QueryDesc *queryDesc, int eflags)
 			Oid			resultRelationOid;
 			Relation	resultRelation;
 
-			resultRelationOid = getrelid(resultRelationIndex, rangeTable);
+			resultRelationOid = exec_rt_fetch(resultRelationIndex, estate)->relid;
 			resultRelation = heap_open(resultRelationOid, RowExclusiveLock);
 			InitResultRelInfo(resultRelInfo,
 							  resultRelation,
@@ -859,7 +973,7 @@ InitPlan(QueryDesc *queryDesc, int eflags)
 			continue;
 
 		/* get relation's OID (will produce InvalidOid if subquery) */
-		relid = getrelid(rc->rti, rangeTable);
+		relid = exec_rt_fetch(rc->rti, estate)->relid;
 
 		/*
 		 * If you change the conditions under which rel locks are acquired
@@ -1509,6 +1623,11 @@ ExecEndPlan(PlanState *planstate, EState *estate)
  *
  *		Runs to completion if numberTuples is 0
  *
+ *		If use_parallel_mode is true, the plan may contain Gather nodes, and
+ *		we run it in parallel mode so that they can launch workers.  This is
+ *		only possible when the whole plan is run to completion in one go,
+ *		because parallel mode must be exited before we return.
+ *
  * Note: the ctid attribute is a 'junk' attribute that is removed before the
  * user can see it
  * ----------------------------------------------------------------
@@ -1516,6 +1635,7 @@ ExecEndPlan(PlanState *planstate, EState *estate)
 static void
 ExecutePlan(EState *estate,
 			PlanState *planstate,
+			bool use_parallel_mode,
 			CmdType operation,
 			bool sendTuples,
 			long numberTuples,
@@ -1535,6 +1655,19 @@ ExecutePlan(EState *estate,
 	 */
 	estate->es_direction = direction;
 
+	/*
+	 * If a tuple count was supplied, we might not run the plan to completion,
+	 * and so we can't stay in parallel mode across calls.  Likewise, SELECT
+	 * INTO must create and fill its target table, which is prohibited in
+	 * parallel mode.  In such cases, any Gather nodes just run their subplans
+	 * locally.
+	 */
+	if (numberTuples != 0 || dest->mydest == DestIntoRel)
+		use_parallel_mode = false;
+
+	if (use_parallel_mode)
+		EnterParallelMode();
+
 	/*
 	 * Loop until we've processed the proper number of tuples from the plan.
 	 */
@@ -1553,7 +1686,11 @@ ExecutePlan(EState *estate,
 		 * process so we just end the loop...
 		 */
 		if (TupIsNull(slot))
+		{
+			/* Allow nodes to release or shut down resources. */
+			ExecShutdownNode(planstate);
 			break;
+		}
 
 		/*
 		 * If we have a junk filter, then project a new tuple with the junk
@@ -1590,6 +1727,9 @@ ExecutePlan(EState *estate,
 		if (numberTuples && numberTuples == current_tuple_count)
 			break;
 	}
+
+	if (use_parallel_mode)
+		ExitParallelMode();
 }
 
 
@@ -2662,7 +2802,7 @@ EvalPlanQualBegin(EPQState *epqstate, EState *parentestate)
 		/*
 		 * We already have a suitable child EPQ tree, so just reset it.
 		 */
-		int			rtsize = list_length(parentestate->es_range_table);
+		int			rtsize = parentestate->es_range_table_size;
 		PlanState  *planstate = epqstate->planstate;
 
 		MemSet(estate->es_epqScanDone, 0, rtsize * sizeof(bool));
@@ -2705,7 +2845,7 @@ EvalPlanQualStart(EPQState *epqstate, EState *parentestate, Plan *planTree)
 	MemoryContext oldcontext;
 	ListCell   *l;
 
-	rtsize = list_length(parentestate->es_range_table);
+	rtsize = parentestate->es_range_table_size;
 
 	epqstate->estate = estate = CreateExecutorState();
 
@@ -2729,6 +2869,8 @@ EvalPlanQualStart(EPQState *epqstate, EState *parentestate, Plan *planTree)
 	estate->es_snapshot = parentestate->es_snapshot;
 	estate->es_crosscheck_snapshot = parentestate->es_crosscheck_snapshot;
 	estate->es_range_table = parentestate->es_range_table;
+	estate->es_range_table_array = parentestate->es_range_table_array;
+	estate->es_range_table_size = parentestate->es_range_table_size;
 	estate->es_plannedstmt = parentestate->es_plannedstmt;
 	estate->es_junkFilter = parentestate->es_junkFilter;
 	estate->es_output_cid = parentestate->es_output_cid;
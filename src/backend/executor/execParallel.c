@@ -0,0 +1,488 @@
+/*-------------------------------------------------------------------------
+ *
+ * execParallel.c
+ *	  Support routines for parallel execution.
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * This file contains routines that are intended to support setting up,
+ * using, and tearing down a ParallelContext from within the PostgreSQL
+ * executor.  The ParallelContext machinery will handle starting the
+ * workers and ensuring that their state generally matches that of the
+ * leader; see src/backend/access/transam/README.parallel for details.
+ * However, we must save and restore relevant executor state, such as
+ * any ParamListInfo associated with the query, buffer usage info, and
+ * the actual plan to be passed down to the worker.
+ *
+ * IDENTIFICATION
+ *	  src/backend/executor/execParallel.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "executor/execParallel.h"
+#include "executor/executor.h"
+#include "executor/nodeBitmapHeapscan.h"
+#include "executor/nodeForeignscan.h"
+#include "executor/nodeHash.h"
+#include "executor/nodeIndexonlyscan.h"
+#include "executor/nodeIndexscan.h"
+#include "executor/nodeSeqscan.h"
+#include "executor/tqueue.h"
+#include "nodes/nodes.h"
+#include "tcop/tcopprot.h"
+#include "utils/memutils.h"
+#include "utils/snapmgr.h"
+
+/*
+ * Magic numbers for parallel executor communication.  We use constants
+ * greater than any 32-bit integer here so that values < 2^32 can be used
+ * by individual parallel nodes to store their own state.
+ */
+#define PARALLEL_KEY_PLANNEDSTMT		UINT64CONST(0xE000000000000001)
+#define PARALLEL_KEY_TUPLE_QUEUE		UINT64CONST(0xE000000000000002)
+
+#define PARALLEL_TUPLE_QUEUE_SIZE		65536
+
+/* Number of tuples a worker processes between checks for an early exit. */
+#define PARALLEL_WORKER_BATCH_SIZE		1000
+
+/* Context object for ExecParallelEstimate. */
+typedef struct ExecParallelEstimateContext
+{
+	ParallelContext *pcxt;
+	int			nnodes;
+} ExecParallelEstimateContext;
+
+/* Helper functions that run in the parallel leader. */
+static char *ExecSerializePlan(Plan *plan, List *rangetable);
+static void ExecParallelEstimate(PlanState *node,
+					 ExecParallelEstimateContext *e);
+static void ExecParallelInitializeDSM(PlanState *node,
+						  ParallelContext *pcxt);
+static shm_mq_handle **ExecParallelSetupTupleQueues(ParallelContext *pcxt);
+
+/* Helper functions that run in the parallel worker. */
+static void ParallelQueryMain(dsm_segment *seg, shm_toc *toc);
+static void ExecParallelInitializeWorker(PlanState *node, shm_toc *toc);
+
+/*
+ * Create a serialized representation of the plan to be sent to each worker.
+ */
+static char *
+ExecSerializePlan(Plan *plan, List *rangetable)
+{
+	PlannedStmt *pstmt;
+
+	/*
+	 * An absolutely minimal PlannedStmt is enough to let the worker run the
+	 * plan.  The planner has already made sure that the parallel portion of
+	 * the plan contains no subplans, parameters, or row marks, so we needn't
+	 * ship any of those.
+	 */
+	pstmt = makeNode(PlannedStmt);
+	pstmt->commandType = CMD_SELECT;
+	pstmt->queryId = 0;
+	pstmt->hasReturning = false;
+	pstmt->hasModifyingCTE = false;
+	pstmt->canSetTag = true;
+	pstmt->transientPlan = false;
+	pstmt->planTree = plan;
+	pstmt->rtable = rangetable;
+	pstmt->resultRelations = NIL;
+	pstmt->utilityStmt = NULL;
+	pstmt->subplans = NIL;
+	pstmt->rewindPlanIDs = NULL;
+	pstmt->rowMarks = NIL;
+	pstmt->relationOids = NIL;
+	pstmt->invalItems = NIL;
+	pstmt->nParamExec = 0;
+	pstmt->hasRowSecurity = false;
+	pstmt->parallelModeNeeded = false;
+
+	/* Return serialized copy of our dummy PlannedStmt. */
+	return nodeToString(pstmt);
+}
+
+/*
+ * Ordinary plan nodes won't do anything here, but parallel-aware plan nodes
+ * may need some state which is shared across all parallel workers.  Before
+ * we size the DSM, give them a chance to call shm_toc_estimate_chunk or
+ * shm_toc_estimate_keys on &pcxt->estimator.
+ */
+static void
+ExecParallelEstimate(PlanState *node, ExecParallelEstimateContext *e)
+{
+	if (node == NULL)
+		return;
+
+	/* Count this node. */
+	e->nnodes++;
+
+	/* Call estimators for parallel-aware nodes. */
+	if (node->plan->parallel_aware)
+	{
+		switch (nodeTag(node))
+		{
+			case T_SeqScanState:
+				ExecSeqScanEstimate((SeqScanState *) node, e->pcxt);
+				break;
+			case T_IndexScanState:
+				ExecIndexScanEstimate((IndexScanState *) node, e->pcxt);
+				break;
+			case T_IndexOnlyScanState:
+				ExecIndexOnlyScanEstimate((IndexOnlyScanState *) node,
+										  e->pcxt);
+				break;
+			case T_BitmapHeapScanState:
+				ExecBitmapHeapEstimate((BitmapHeapScanState *) node,
+									   e->pcxt);
+				break;
+			case T_ForeignScanState:
+				ExecForeignScanEstimate((ForeignScanState *) node,
+										e->pcxt);
+				break;
+			case T_HashState:
+				ExecHashEstimate((HashState *) node, e->pcxt);
+				break;
+			default:
+				break;
+		}
+	}
+
+	ExecParallelEstimate(outerPlanState(node), e);
+	ExecParallelEstimate(innerPlanState(node), e);
+}
+
+/*
+ * Give parallel-aware nodes a chance to initialize their shared data.  This
+ * needs to run after the DSM segment has been created.
+ */
+static void
+ExecParallelInitializeDSM(PlanState *node, ParallelContext *pcxt)
+{
+	if (node == NULL)
+		return;
+
+	if (node->plan->parallel_aware)
+	{
+		switch (nodeTag(node))
+		{
+			case T_SeqScanState:
+				ExecSeqScanInitializeDSM((SeqScanState *) node, pcxt);
+				break;
+			case T_IndexScanState:
+				ExecIndexScanInitializeDSM((IndexScanState *) node, pcxt);
+				break;
+			case T_IndexOnlyScanState:
+				ExecIndexOnlyScanInitializeDSM((IndexOnlyScanState *) node,
+											   pcxt);
+				break;
+			case T_BitmapHeapScanState:
+				ExecBitmapHeapInitializeDSM((BitmapHeapScanState *) node,
+											pcxt);
+				break;
+			case T_ForeignScanState:
+				ExecForeignScanInitializeDSM((ForeignScanState *) node,
+											 pcxt);
+				break;
+			case T_HashState:
+				ExecHashInitializeDSM((HashState *) node, pcxt);
+				break;
+			default:
+				break;
+		}
+	}
+
+	ExecParallelInitializeDSM(outerPlanState(node), pcxt);
+	ExecParallelInitializeDSM(innerPlanState(node), pcxt);
+}
+
+/*
+ * It sets up the response queues for backend workers to return tuples
+ * to the main backend and start the workers.
+ */
+static shm_mq_handle **
+ExecParallelSetupTupleQueues(ParallelContext *pcxt)
+{
+	shm_mq_handle **responseq;
+	char	   *tqueuespace;
+	int			i;
+
+	/* Skip this if no workers. */
+	if (pcxt->nworkers == 0)
+		return NULL;
+
+	/* Allocate memory for shared memory queue handles. */
+	responseq = (shm_mq_handle **)
+		palloc(pcxt->nworkers * sizeof(shm_mq_handle *));
+
+	/* Allocate space from the DSM for the queues themselves. */
+	tqueuespace = shm_toc_allocate(pcxt->toc,
+								 PARALLEL_TUPLE_QUEUE_SIZE * pcxt->nworkers);
+
+	/* Create the queues, and become the receiver for each. */
+	for (i = 0; i < pcxt->nworkers; ++i)
+	{
+		shm_mq	   *mq;
+
+		mq = shm_mq_create(tqueuespace + i * PARALLEL_TUPLE_QUEUE_SIZE,
+						   (Size) PARALLEL_TUPLE_QUEUE_SIZE);
+
+		shm_mq_set_receiver(mq, MyProc);
+		responseq[i] = shm_mq_attach(mq, pcxt->seg, NULL);
+	}
+
+	/* Add array of queues to shm_toc, so others can find it. */
+	shm_toc_insert(pcxt->toc, PARALLEL_KEY_TUPLE_QUEUE, tqueuespace);
+
+	/* Return array of handles. */
+	return responseq;
+}
+
+/*
+ * Sets up the required infrastructure for backend workers to perform
+ * execution and return results to the main backend.
+ */
+ParallelExecutorInfo *
+ExecInitParallelPlan(PlanState *planstate, EState *estate, int nworkers)
+{
+	ParallelExecutorInfo *pei;
+	ParallelContext *pcxt;
+	ExecParallelEstimateContext e;
+	char	   *pstmt_data;
+	char	   *pstmt_space;
+	int			pstmt_len;
+
+	/* Allocate object for return value. */
+	pei = palloc0(sizeof(ParallelExecutorInfo));
+	pei->planstate = planstate;
+
+	/* Fix up and serialize plan to be sent to workers. */
+	pstmt_data = ExecSerializePlan(planstate->plan, estate->es_range_table);
+
+	/* Create a parallel context. */
+	pcxt = CreateParallelContext(ParallelQueryMain, nworkers);
+	pei->pcxt = pcxt;
+
+	/*
+	 * Before telling the parallel context to create a dynamic shared memory
+	 * segment, we need to figure out how big it should be.  Estimate space
+	 * for the various things we need to store.
+	 */
+
+	/* Estimate space for serialized PlannedStmt. */
+	pstmt_len = strlen(pstmt_data) + 1;
+	shm_toc_estimate_chunk(&pcxt->estimator, pstmt_len);
+	shm_toc_estimate_keys(&pcxt->estimator, 1);
+
+	/* Estimate space for tuple queues. */
+	shm_toc_estimate_chunk(&pcxt->estimator,
+						   PARALLEL_TUPLE_QUEUE_SIZE * pcxt->nworkers);
+	shm_toc_estimate_keys(&pcxt->estimator, 1);
+
+	/* Give parallel-aware nodes a chance to add to the estimates. */
+	e.pcxt = pcxt;
+	e.nnodes = 0;
+	ExecParallelEstimate(planstate, &e);
+
+	/* Everyone's had a chance to ask for space, so now create the DSM. */
+	InitializeParallelDSM(pcxt);
+
+	/*
+	 * OK, now we have a dynamic shared memory segment, and it should be big
+	 * enough to store all of the data we estimated we would want to put into
+	 * it, plus whatever general stuff (not specifically executor-related) the
+	 * ParallelContext itself needs to store there.  None of the space we
+	 * asked for has been allocated or initialized yet, though, so do that.
+	 */
+
+	/* Store serialized PlannedStmt. */
+	pstmt_space = shm_toc_allocate(pcxt->toc, pstmt_len);
+	memcpy(pstmt_space, pstmt_data, pstmt_len);
+	shm_toc_insert(pcxt->toc, PARALLEL_KEY_PLANNEDSTMT, pstmt_space);
+
+	/* Set up tuple queues. */
+	pei->tqueue = ExecParallelSetupTupleQueues(pcxt);
+
+	/*
+	 * If we could not create a DSM segment, InitializeParallelDSM will have
+	 * reduced the number of workers to zero, and there'll be nothing for
+	 * parallel-aware nodes to initialize.  They'll simply run locally.
+	 */
+	if (pcxt->seg != NULL)
+		ExecParallelInitializeDSM(planstate, pcxt);
+
+	/* OK, we're ready to rock and roll. */
+	return pei;
+}
+
+/*
+ * Finish parallel execution.  We wait for parallel workers to finish, and
+ * make sure that any errors they may have thrown are reported.
+ */
+void
+ExecParallelFinish(ParallelExecutorInfo *pei)
+{
+	if (pei->finished)
+		return;
+
+	WaitForParallelWorkersToFinish(pei->pcxt);
+	pei->finished = true;
+}
+
+/*
+ * Clean up whatever ParallelExecutorInfo resources still exist.  If the
+ * workers haven't finished yet, destroying the parallel context kills them.
+ */
+void
+ExecParallelCleanup(ParallelExecutorInfo *pei)
+{
+	if (pei->pcxt != NULL)
+	{
+		DestroyParallelContext(pei->pcxt);
+		pei->pcxt = NULL;
+	}
+	pfree(pei);
+}
+
+/*
+ * Create a DestReceiver to write tuples we produce to the shm_mq designated
+ * for that purpose.
+ */
+static DestReceiver *
+ExecParallelGetReceiver(dsm_segment *seg, shm_toc *toc)
+{
+	char	   *mqspace;
+	shm_mq	   *mq;
+
+	mqspace = shm_toc_lookup(toc, PARALLEL_KEY_TUPLE_QUEUE);
+	if (mqspace == NULL)
+		elog(ERROR, "could not find tuple queue for parallel worker");
+	mqspace += ParallelWorkerNumber * PARALLEL_TUPLE_QUEUE_SIZE;
+	mq = (shm_mq *) mqspace;
+	shm_mq_set_sender(mq, MyProc);
+	return CreateTupleQueueDestReceiver(shm_mq_attach(mq, seg, NULL));
+}
+
+/*
+ * Create a QueryDesc for the PlannedStmt we are to execute, and return it.
+ */
+static QueryDesc *
+ExecParallelGetQueryDesc(shm_toc *toc, DestReceiver *receiver)
+{
+	char	   *pstmtspace;
+	PlannedStmt *pstmt;
+
+	/* Reconstruct leader-supplied PlannedStmt. */
+	pstmtspace = shm_toc_lookup(toc, PARALLEL_KEY_PLANNEDSTMT);
+	if (pstmtspace == NULL)
+		elog(ERROR, "could not find plan for parallel worker");
+	pstmt = (PlannedStmt *) stringToNode(pstmtspace);
+
+	/* Create a QueryDesc for the query. */
+	return CreateQueryDesc(pstmt,
+						   "<parallel query>",
+						   GetActiveSnapshot(), InvalidSnapshot,
+						   receiver, NULL, 0);
+}
+
+/*
+ * Initialize the PlanState and its descendents with the information
+ * retrieved from shared memory.  This has to be done once the PlanState
+ * is allocated and initialized by executor; that is, after ExecutorStart().
+ */
+static void
+ExecParallelInitializeWorker(PlanState *node, shm_toc *toc)
+{
+	if (node == NULL)
+		return;
+
+	/* Call initializers for parallel-aware plan nodes. */
+	if (node->plan->parallel_aware)
+	{
+		switch (nodeTag(node))
+		{
+			case T_SeqScanState:
+				ExecSeqScanInitializeWorker((SeqScanState *) node, toc);
+				break;
+			case T_IndexScanState:
+				ExecIndexScanInitializeWorker((IndexScanState *) node, toc);
+				break;
+			case T_IndexOnlyScanState:
+				ExecIndexOnlyScanInitializeWorker((IndexOnlyScanState *) node,
+												  toc);
+				break;
+			case T_BitmapHeapScanState:
+				ExecBitmapHeapInitializeWorker((BitmapHeapScanState *) node,
+											   toc);
+				break;
+			case T_ForeignScanState:
+				ExecForeignScanInitializeWorker((ForeignScanState *) node,
+												toc);
+				break;
+			case T_HashState:
+				ExecHashInitializeWorker((HashState *) node, toc);
+				break;
+			default:
+				break;
+		}
+	}
+
+	ExecParallelInitializeWorker(outerPlanState(node), toc);
+	ExecParallelInitializeWorker(innerPlanState(node), toc);
+}
+
+/*
+ * Main entrypoint for parallel query worker processes.
+ *
+ * We reach this function from ParallelWorkerMain, so the setup necessary to
+ * create a sensible parallel environment has already been done;
+ * ParallelWorkerMain worries about stuff like the transaction state, combo
+ * CID mappings, and GUC values, so we don't need to deal with any of that
+ * here.
+ *
+ * Our job is to deal with concerns specific to the executor.  The parallel
+ * group leader will have stored a serialized PlannedStmt, and it's our job
+ * to execute that plan and write the resulting tuples to the appropriate
+ * tuple queue.  If the leader loses interest before we're done, it detaches
+ * from the queue; we notice that between batches and stop early.
+ */
+static void
+ParallelQueryMain(dsm_segment *seg, shm_toc *toc)
+{
+	DestReceiver *receiver;
+	QueryDesc  *queryDesc;
+
+	/* Set up DestReceiver and QueryDesc. */
+	receiver = ExecParallelGetReceiver(seg, toc);
+	queryDesc = ExecParallelGetQueryDesc(toc, receiver);
+
+	/* Call ExecutorStart to prepare the plan for execution. */
+	ExecutorStart(queryDesc, 0);
+
+	/* Special executor initialization steps for parallel workers */
+	ExecParallelInitializeWorker(queryDesc->planstate, toc);
+
+	/* Run the plan, stopping early if the leader goes away. */
+	for (;;)
+	{
+		ExecutorRun(queryDesc, ForwardScanDirection,
+					PARALLEL_WORKER_BATCH_SIZE);
+		if (queryDesc->estate->es_processed < PARALLEL_WORKER_BATCH_SIZE)
+			break;
+		if (TupleQueueDestReceiverDetached(receiver))
+			break;
+	}
+
+	/* Shut down the executor */
+	ExecutorFinish(queryDesc);
+	ExecutorEnd(queryDesc);
+
+	/* Cleanup. */
+	FreeQueryDesc(queryDesc);
+	(*receiver->rDestroy) (receiver);
+}
@@ -21,6 +21,7 @@
  *		ExecInitNode	-		initialize a plan node and its subplans
  *		ExecProcNode	-		get a tuple by executing the plan node
  *		ExecEndNode		-		shut down a plan node and its subplans
+ *		ExecShutdownNode -		release resources a plan node no longer needs
  *
  *	 NOTES
  *		This used to be three files.  It is now all combined into
@@ -88,14 +89,17 @@
 #include "executor/nodeCustom.h"
 #include "executor/nodeForeignscan.h"
 #include "executor/nodeFunctionscan.h"
+#include "executor/nodeGather.h"
 #include "executor/nodeGroup.h"
 #include "executor/nodeHash.h"
 #include "executor/nodeHashjoin.h"
+#include "executor/nodeIncrementalSort.h"
 #include "executor/nodeIndexonlyscan.h"
 #include "executor/nodeIndexscan.h"
 #include "executor/nodeLimit.h"
 #include "executor/nodeLockRows.h"
 #include "executor/nodeMaterial.h"
+#include "executor/nodeMemoize.h"
 #include "executor/nodeMergeAppend.h"
 #include "executor/nodeMergejoin.h"
 #include "executor/nodeModifyTable.h"
@@ -282,11 +286,21 @@ ExecInitNode(Plan *node, EState *estate, int eflags)
 													estate, eflags);
 			break;
 
+		case T_Memoize:
+			result = (PlanState *) ExecInitMemoize((Memoize *) node,
+												   estate, eflags);
+			break;
+
 		case T_Sort:
 			result = (PlanState *) ExecInitSort((Sort *) node,
 												estate, eflags);
 			break;
 
+		case T_IncrementalSort:
+			result = (PlanState *) ExecInitIncrementalSort((IncrementalSort *) node,
+														   estate, eflags);
+			break;
+
 		case T_Group:
 			result = (PlanState *) ExecInitGroup((Group *) node,
 												 estate, eflags);
@@ -307,6 +321,11 @@ ExecInitNode(Plan *node, EState *estate, int eflags)
 												  estate, eflags);
 			break;
 
+		case T_Gather:
+			result = (PlanState *) ExecInitGather((Gather *) node,
+												  estate, eflags);
+			break;
+
 		case T_Hash:
 			result = (PlanState *) ExecInitHash((Hash *) node,
 												estate, eflags);
@@ -484,10 +503,18 @@ ExecProcNode(PlanState *node)
 			result = ExecMaterial((MaterialState *) node);
 			break;
 
+		case T_MemoizeState:
+			result = ExecMemoize((MemoizeState *) node);
+			break;
+
 		case T_SortState:
 			result = ExecSort((SortState *) node);
 			break;
 
+		case T_IncrementalSortState:
+			result = ExecIncrementalSort((IncrementalSortState *) node);
+			break;
+
 		case T_GroupState:
 			result = ExecGroup((GroupState *) node);
 			break;
@@ -504,6 +531,10 @@ ExecProcNode(PlanState *node)
 			result = ExecUnique((UniqueState *) node);
 			break;
 
+		case T_GatherState:
+			result = ExecGather((GatherState *) node);
+			break;
+
 		case T_HashState:
 			result = ExecHash((HashState *) node);
 			break;
@@ -728,10 +759,18 @@ ExecEndNode(PlanState *node)
 			ExecEndMaterial((MaterialState *) node);
 			break;
 
+		case T_MemoizeState:
+			ExecEndMemoize((MemoizeState *) node);
+			break;
+
 		case T_SortState:
 			ExecEndSort((SortState *) node);
 			break;
 
+		case T_IncrementalSortState:
+			ExecEndIncrementalSort((IncrementalSortState *) node);
+			break;
+
 		case T_GroupState:
 			ExecEndGroup((GroupState *) node);
 			break;
@@ -748,6 +787,10 @@ ExecEndNode(PlanState *node)
 			ExecEndUnique((UniqueState *) node);
 			break;
 
+		case T_GatherState:
+			ExecEndGather((GatherState *) node);
+			break;
+
 		case T_HashState:
 			ExecEndHash((HashState *) node);
 			break;
@@ -769,3 +812,66 @@ ExecEndNode(PlanState *node)
 			break;
 	}
 }
+
+/* ----------------------------------------------------------------
+ *		ExecShutdownNode
+ *
+ *		Give execution nodes a chance to stop asynchronous resource
+ *		consumption and release any resources still held.  Currently,
+ *		this is only used for parallel query, where the Gather node
+ *		must tear down its workers and dynamic shared memory before
+ *		parallel mode can be exited.
+ * ----------------------------------------------------------------
+ */
+void
+ExecShutdownNode(PlanState *node)
+{
+	ListCell   *l;
+	int			i;
+
+	if (node == NULL)
+		return;
+
+	switch (nodeTag(node))
+	{
+		case T_GatherState:
+			ExecShutdownGather((GatherState *) node);
+			break;
+
+		case T_AppendState:
+			for (i = 0; i < ((AppendState *) node)->as_nplans; i++)
+				ExecShutdownNode(((AppendState *) node)->appendplans[i]);
+			break;
+
+		case T_MergeAppendState:
+			for (i = 0; i < ((MergeAppendState *) node)->ms_nplans; i++)
+				ExecShutdownNode(((MergeAppendState *) node)->mergeplans[i]);
+			break;
+
+		case T_BitmapAndState:
+			for (i = 0; i < ((BitmapAndState *) node)->nplans; i++)
+				ExecShutdownNode(((BitmapAndState *) node)->bitmapplans[i]);
+			break;
+
+		case T_BitmapOrState:
+			for (i = 0; i < ((BitmapOrState *) node)->nplans; i++)
+				ExecShutdownNode(((BitmapOrState *) node)->bitmapplans[i]);
+			break;
+
+		case T_SubqueryScanState:
+			ExecShutdownNode(((SubqueryScanState *) node)->subplan);
+			break;
+
+		default:
+			break;
+	}
+
+	/* Subplans could also contain Gather nodes. */
+	foreach(l, node->initPlan)
+		ExecShutdownNode(((SubPlanState *) lfirst(l))->planstate);
+	foreach(l, node->subPlan)
+		ExecShutdownNode(((SubPlanState *) lfirst(l))->planstate);
+
+	ExecShutdownNode(outerPlanState(node));
+	ExecShutdownNode(innerPlanState(node));
+}
@@ -39,6 +39,7 @@
 #include "access/htup_details.h"
 #include "access/nbtree.h"
 #include "access/tupconvert.h"
+#include "access/tuptoaster.h"
 #include "catalog/objectaccess.h"
 #include "catalog/pg_type.h"
 #include "executor/execdebug.h"
@@ -59,6 +60,43 @@
 #include "utils/xml.h"
 
 
+/* An entry of ExprContext.ecxt_toast_values */
+typedef struct ToastValueEntry
+{
+	Oid			toastrelid;		/* toast pointer of the value */
+	Oid			valueid;
+	Datum		value;			/* R/O pointer to expanded toast value */
+} ToastValueEntry;
+
+/*
+ * Hash table of the elements of a constant array, used to evaluate
+ * "scalar = ANY (array)" by ExecEvalHashedScalarArrayOp.  It uses open
+ * addressing with linear probing.  NULL elements are not stored, only
+ * remembered.
+ */
+typedef struct ScalarArrayOpHashTable
+{
+	FmgrInfo	hash_finfo;		/* hash function for the element type */
+	uint32		mask;			/* number of buckets, minus one */
+	bool	   *used;			/* is the bucket occupied? */
+	uint32	   *hashes;			/* hash values of the stored elements */
+	Datum	   *values;			/* the stored elements */
+	bool		has_nulls;		/* did the array contain any NULLs? */
+} ScalarArrayOpHashTable;
+
+/*
+ * Arrays with fewer elements than this are searched linearly, since the
+ * cost of building a hash table wouldn't pay off.
+ */
+#define MIN_ARRAY_SIZE_FOR_HASHED_SAOP	9
+
+/* State for count_var_references_walker */
+typedef struct count_var_references_context
+{
+	Var		   *variable;		/* Var to look for */
+	int			count;			/* references found so far */
+} count_var_references_context;
+
 /* static function decls */
 static Datum ExecEvalArrayRef(ArrayRefExprState *astate,
 				 ExprContext *econtext,
@@ -74,6 +112,16 @@ static Datum ExecEvalScalarVar(ExprState *exprstate, ExprContext *econtext,
 				  bool *isNull, ExprDoneCond *isDone);
 static Datum ExecEvalScalarVarFast(ExprState *exprstate, ExprContext *econtext,
 					  bool *isNull, ExprDoneCond *isDone);
+static Datum ExecEvalScalarVarToast(ExprState *exprstate, ExprContext *econtext,
+					   bool *isNull, ExprDoneCond *isDone);
+static Datum ExecEvalScalarVarToastFast(ExprState *exprstate,
+						   ExprContext *econtext,
+						   bool *isNull, ExprDoneCond *isDone);
+static Datum ExecGetToastValue(ExprContext *econtext, Datum value);
+static void ExecForgetToastValues(void *arg);
+static bool ExecVarNeedsToastCache(Var *variable, PlanState *parent);
+static bool count_var_references_walker(Node *node,
+							count_var_references_context *context);
 static Datum ExecEvalWholeRowVar(WholeRowVarExprState *wrvstate,
 					ExprContext *econtext,
 					bool *isNull, ExprDoneCond *isDone);
@@ -118,6 +166,14 @@ static Datum ExecEvalDistinct(FuncExprState *fcache, ExprContext *econtext,
 static Datum ExecEvalScalarArrayOp(ScalarArrayOpExprState *sstate,
 					  ExprContext *econtext,
 					  bool *isNull, ExprDoneCond *isDone);
+static bool saop_build_hash_table(ScalarArrayOpExprState *sstate,
+					  ExprContext *econtext);
+static bool saop_hash_lookup(ScalarArrayOpExprState *sstate,
+				 ScalarArrayOpHashTable *htab,
+				 Datum value, uint32 hashvalue);
+static Datum ExecEvalHashedScalarArrayOp(ScalarArrayOpExprState *sstate,
+							ExprContext *econtext,
+							bool *isNull, ExprDoneCond *isDone);
 static Datum ExecEvalNot(BoolExprState *notclause, ExprContext *econtext,
 			bool *isNull, ExprDoneCond *isDone);
 static Datum ExecEvalOr(BoolExprState *orExpr, ExprContext *econtext,
@@ -687,6 +743,117 @@ ExecEvalScalarVarFast(ExprState *exprstate, ExprContext *econtext,
 	return slot_getattr(slot, attnum, isNull);
 }
 
+/* ----------------------------------------------------------------
+ *		ExecEvalScalarVarToast
+ *
+ *		Returns a Datum for a scalar variable of a varlena type that the
+ *		expressions of the plan node refer to more than once.  If the value
+ *		is stored out of line, what's returned is an expanded toast value
+ *		for it, shared by all such Vars that fetch the same value for the
+ *		current tuple; so however often the value is used, it's detoasted
+ *		at most once.  See ExecVarNeedsToastCache.
+ *
+ * Like ExecEvalScalarVar, this is executed only the first time through,
+ * and passes control to ExecEvalScalarVarToastFast afterwards.
+ * ----------------------------------------------------------------
+ */
+static Datum
+ExecEvalScalarVarToast(ExprState *exprstate, ExprContext *econtext,
+					   bool *isNull, ExprDoneCond *isDone)
+{
+	Datum		result;
+
+	result = ExecEvalScalarVar(exprstate, econtext, isNull, isDone);
+
+	/* Skip the checking on future executions of node */
+	exprstate->evalfunc = ExecEvalScalarVarToastFast;
+
+	if (*isNull || !VARATT_IS_EXTERNAL_ONDISK(DatumGetPointer(result)))
+		return result;
+	return ExecGetToastValue(econtext, result);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecEvalScalarVarToastFast
+ *
+ *		Returns a Datum for a scalar variable of a varlena type, as above.
+ * ----------------------------------------------------------------
+ */
+static Datum
+ExecEvalScalarVarToastFast(ExprState *exprstate, ExprContext *econtext,
+						   bool *isNull, ExprDoneCond *isDone)
+{
+	Datum		result;
+
+	result = ExecEvalScalarVarFast(exprstate, econtext, isNull, isDone);
+
+	if (*isNull || !VARATT_IS_EXTERNAL_ONDISK(DatumGetPointer(result)))
+		return result;
+	return ExecGetToastValue(econtext, result);
+}
+
+/*
+ * Find or make the expanded toast value for an out-of-line value in the
+ * ExprContext's per-tuple list.  Values are identified by their toast
+ * pointers, which can't be reused while the tuple is being processed.
+ */
+static Datum
+ExecGetToastValue(ExprContext *econtext, Datum value)
+{
+	struct varatt_external toast_pointer;
+	ListCell   *lc;
+	ToastValueEntry *entry;
+	MemoryContext oldcontext;
+
+	VARATT_EXTERNAL_GET_POINTER(toast_pointer, DatumGetPointer(value));
+
+	foreach(lc, econtext->ecxt_toast_values)
+	{
+		entry = (ToastValueEntry *) lfirst(lc);
+
+		if (entry->valueid == toast_pointer.va_valueid &&
+			entry->toastrelid == toast_pointer.va_toastrelid)
+			return entry->value;
+	}
+
+	oldcontext = MemoryContextSwitchTo(econtext->ecxt_per_tuple_memory);
+
+	/* Forget the list when the memory it's in goes away */
+	if (econtext->ecxt_toast_values == NIL)
+	{
+		MemoryContextCallback *cb;
+
+		cb = (MemoryContextCallback *) palloc(sizeof(MemoryContextCallback));
+		cb->func = ExecForgetToastValues;
+		cb->arg = (void *) econtext;
+		MemoryContextRegisterResetCallback(econtext->ecxt_per_tuple_memory,
+										   cb);
+	}
+
+	entry = (ToastValueEntry *) palloc(sizeof(ToastValueEntry));
+	entry->toastrelid = toast_pointer.va_toastrelid;
+	entry->valueid = toast_pointer.va_valueid;
+
+	/* Functions mustn't change the value, so hand out a read-only pointer */
+	entry->value = expand_toast_value(value, econtext->ecxt_per_tuple_memory);
+	entry->value = MakeExpandedObjectReadOnly(entry->value, false, -1);
+
+	econtext->ecxt_toast_values = lappend(econtext->ecxt_toast_values, entry);
+
+	MemoryContextSwitchTo(oldcontext);
+
+	return entry->value;
+}
+
+/* Memory context reset callback for ExecGetToastValue */
+static void
+ExecForgetToastValues(void *arg)
+{
+	ExprContext *econtext = (ExprContext *) arg;
+
+	econtext->ecxt_toast_values = NIL;
+}
+
 /* ----------------------------------------------------------------
  *		ExecEvalWholeRowVar
  *
@@ -897,10 +1064,10 @@ ExecEvalWholeRowVar(WholeRowVarExprState *wrvstate, ExprContext *econtext,
 	 * column names are OK.  (This happens in COPY, and perhaps other places.)
 	 */
 	if (econtext->ecxt_estate &&
-		variable->varno <= list_length(econtext->ecxt_estate->es_range_table))
+		variable->varno <= econtext->ecxt_estate->es_range_table_size)
 	{
-		RangeTblEntry *rte = rt_fetch(variable->varno,
-									  econtext->ecxt_estate->es_range_table);
+		RangeTblEntry *rte = exec_rt_fetch(variable->varno,
+										   econtext->ecxt_estate);
 
 		if (rte->eref)
 			ExecTypeSetColNames(output_tupdesc, rte->eref->colnames);
@@ -2551,13 +2718,23 @@ ExecEvalScalarArrayOp(ScalarArrayOpExprState *sstate,
 		*isDone = ExprSingleResult;
 
 	/*
-	 * Initialize function cache if first time through
+	 * Initialize function cache if first time through.  If the array is a
+	 * large enough constant, switch to evaluating the expression by probing
+	 * a hash table of its elements instead.
 	 */
 	if (sstate->fxprstate.func.fn_oid == InvalidOid)
 	{
 		init_fcache(opexpr->opfuncid, opexpr->inputcollid, &sstate->fxprstate,
 					econtext->ecxt_per_query_memory, true);
 		Assert(!sstate->fxprstate.func.fn_retset);
+
+		if (saop_build_hash_table(sstate, econtext))
+		{
+			sstate->fxprstate.xprstate.evalfunc =
+				(ExprStateEvalFunc) ExecEvalHashedScalarArrayOp;
+			return ExecEvalHashedScalarArrayOp(sstate, econtext,
+											   isNull, isDone);
+		}
 	}
 
 	/*
@@ -2697,6 +2874,210 @@ ExecEvalScalarArrayOp(ScalarArrayOpExprState *sstate,
 	return result;
 }
 
+/*
+ * saop_build_hash_table
+ *
+ * If "scalar op ANY (array)" compares against a constant array of at least
+ * MIN_ARRAY_SIZE_FOR_HASHED_SAOP elements using a strict, hashable equality
+ * operator, build a hash table of the array's elements in per-query memory
+ * and return true.  Otherwise return false, and the expression is evaluated
+ * by ExecEvalScalarArrayOp's linear search.
+ */
+static bool
+saop_build_hash_table(ScalarArrayOpExprState *sstate, ExprContext *econtext)
+{
+	ScalarArrayOpExpr *opexpr = (ScalarArrayOpExpr *) sstate->fxprstate.xprstate.expr;
+	Const	   *arrayconst = (Const *) lsecond(opexpr->args);
+	ScalarArrayOpHashTable *htab;
+	MemoryContext oldcontext;
+	Oid			lefthashfn;
+	Oid			righthashfn;
+	ArrayType  *arr;
+	int			nitems;
+	uint32		nbuckets;
+	char	   *s;
+	bits8	   *bitmap;
+	int			bitmask;
+	int			i;
+
+	if (!opexpr->useOr ||
+		!IsA(arrayconst, Const) ||
+		arrayconst->constisnull ||
+		!sstate->fxprstate.func.fn_strict)
+		return false;
+
+	/* Hashing is only valid if both inputs use the same hash function */
+	if (!get_op_hash_functions(opexpr->opno, &lefthashfn, &righthashfn) ||
+		lefthashfn != righthashfn)
+		return false;
+
+	oldcontext = MemoryContextSwitchTo(econtext->ecxt_per_query_memory);
+
+	arr = DatumGetArrayTypeP(arrayconst->constvalue);
+	nitems = ArrayGetNItems(ARR_NDIM(arr), ARR_DIMS(arr));
+	if (nitems < MIN_ARRAY_SIZE_FOR_HASHED_SAOP)
+	{
+		MemoryContextSwitchTo(oldcontext);
+		return false;
+	}
+
+	get_typlenbyvalalign(ARR_ELEMTYPE(arr),
+						 &sstate->typlen,
+						 &sstate->typbyval,
+						 &sstate->typalign);
+	sstate->element_type = ARR_ELEMTYPE(arr);
+
+	/* Keep the load factor at or below 50% */
+	nbuckets = 1;
+	while (nbuckets < (uint32) nitems * 2)
+		nbuckets <<= 1;
+
+	htab = (ScalarArrayOpHashTable *) palloc(sizeof(ScalarArrayOpHashTable));
+	execHashFunctionInfo(lefthashfn, &htab->hash_finfo);
+	htab->mask = nbuckets - 1;
+	htab->used = (bool *) palloc0(nbuckets * sizeof(bool));
+	htab->hashes = (uint32 *) palloc(nbuckets * sizeof(uint32));
+	htab->values = (Datum *) palloc(nbuckets * sizeof(Datum));
+	htab->has_nulls = false;
+
+	/*
+	 * Insert the non-NULL elements, skipping duplicates.  The stored Datums
+	 * point into the array, which lives as long as the plan does.
+	 */
+	s = (char *) ARR_DATA_PTR(arr);
+	bitmap = ARR_NULLBITMAP(arr);
+	bitmask = 1;
+
+	for (i = 0; i < nitems; i++)
+	{
+		if (bitmap && (*bitmap & bitmask) == 0)
+			htab->has_nulls = true;
+		else
+		{
+			Datum		elt = fetch_att(s, sstate->typbyval, sstate->typlen);
+			uint32		hashvalue;
+
+			s = att_addlength_pointer(s, sstate->typlen, s);
+			s = (char *) att_align_nominal(s, sstate->typalign);
+
+			hashvalue = DatumGetUInt32(FunctionCall1Coll(&htab->hash_finfo,
+														 opexpr->inputcollid,
+														 elt));
+			if (!saop_hash_lookup(sstate, htab, elt, hashvalue))
+			{
+				uint32		bucket = hashvalue & htab->mask;
+
+				while (htab->used[bucket])
+					bucket = (bucket + 1) & htab->mask;
+				htab->used[bucket] = true;
+				htab->hashes[bucket] = hashvalue;
+				htab->values[bucket] = elt;
+			}
+		}
+
+		/* advance bitmap pointer if any */
+		if (bitmap)
+		{
+			bitmask <<= 1;
+			if (bitmask == 0x100)
+			{
+				bitmap++;
+				bitmask = 1;
+			}
+		}
+	}
+
+	MemoryContextSwitchTo(oldcontext);
+
+	sstate->elements_tab = htab;
+	return true;
+}
+
+/*
+ * saop_hash_lookup
+ *
+ * Is "value", whose hash is "hashvalue", equal to some element stored in the
+ * hash table according to the expression's operator?
+ */
+static bool
+saop_hash_lookup(ScalarArrayOpExprState *sstate, ScalarArrayOpHashTable *htab,
+				 Datum value, uint32 hashvalue)
+{
+	FunctionCallInfo fcinfo = &sstate->fxprstate.fcinfo_data;
+	uint32		bucket = hashvalue & htab->mask;
+
+	while (htab->used[bucket])
+	{
+		if (htab->hashes[bucket] == hashvalue)
+		{
+			Datum		result;
+
+			fcinfo->arg[0] = value;
+			fcinfo->argnull[0] = false;
+			fcinfo->arg[1] = htab->values[bucket];
+			fcinfo->argnull[1] = false;
+			fcinfo->isnull = false;
+			result = FunctionCallInvoke(fcinfo);
+			if (!fcinfo->isnull && DatumGetBool(result))
+				return true;
+		}
+		bucket = (bucket + 1) & htab->mask;
+	}
+
+	return false;
+}
+
+/*
+ * ExecEvalHashedScalarArrayOp
+ *
+ * Evaluate "scalar op ANY (constant array)" by probing the hash table built
+ * by saop_build_hash_table, rather than comparing the scalar against every
+ * element.  The result is the same as ExecEvalScalarArrayOp's: the operator
+ * is strict, so a NULL scalar yields NULL, and so does a scalar matching no
+ * element when the array contains NULLs.
+ */
+static Datum
+ExecEvalHashedScalarArrayOp(ScalarArrayOpExprState *sstate,
+							ExprContext *econtext,
+							bool *isNull, ExprDoneCond *isDone)
+{
+	ScalarArrayOpExpr *opexpr = (ScalarArrayOpExpr *) sstate->fxprstate.xprstate.expr;
+	ScalarArrayOpHashTable *htab = sstate->elements_tab;
+	Datum		scalar;
+	bool		scalarnull;
+	ExprDoneCond argDone;
+	uint32		hashvalue;
+
+	/* Set default values for result flags: non-null, not a set result */
+	*isNull = false;
+	if (isDone)
+		*isDone = ExprSingleResult;
+
+	scalar = ExecEvalExpr((ExprState *) linitial(sstate->fxprstate.args),
+						  econtext, &scalarnull, &argDone);
+	if (argDone != ExprSingleResult)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATATYPE_MISMATCH),
+			   errmsg("op ANY/ALL (array) does not support set arguments")));
+
+	if (scalarnull)
+	{
+		*isNull = true;
+		return (Datum) 0;
+	}
+
+	hashvalue = DatumGetUInt32(FunctionCall1Coll(&htab->hash_finfo,
+												 opexpr->inputcollid,
+												 scalar));
+	if (saop_hash_lookup(sstate, htab, scalar, hashvalue))
+		return BoolGetDatum(true);
+
+	/* Not found; the result is NULL if any element was NULL */
+	if (htab->has_nulls)
+		*isNull = true;
+	return BoolGetDatum(false);
+}
+
 /* ----------------------------------------------------------------
  *		ExecEvalNot
  *		ExecEvalOr
@@ -4452,7 +4833,10 @@ ExecInitExpr(Expr *node, PlanState *parent)
 			else
 			{
 				state = (ExprState *) makeNode(ExprState);
-				state->evalfunc = ExecEvalScalarVar;
+				if (ExecVarNeedsToastCache((Var *) node, parent))
+					state->evalfunc = ExecEvalScalarVarToast;
+				else
+					state->evalfunc = ExecEvalScalarVar;
 			}
 			break;
 		case T_Const:
@@ -4665,6 +5049,7 @@ ExecInitExpr(Expr *node, PlanState *parent)
 					ExecInitExpr((Expr *) opexpr->args, parent);
 				sstate->fxprstate.func.fn_oid = InvalidOid;		/* not initialized */
 				sstate->element_type = InvalidOid;		/* ditto */
+				sstate->elements_tab = NULL;
 				state = (ExprState *) sstate;
 			}
 			break;
@@ -5161,6 +5546,60 @@ ExecInitExpr(Expr *node, PlanState *parent)
 	return state;
 }
 
+/*
+ * ExecVarNeedsToastCache --- should a Var share detoasted values?
+ *
+ * That's worthwhile for a Var of a varlena type, if the targetlist and qual
+ * of the plan node contain more than one reference to the same column, as
+ * in "doc->'a', doc->'b'": without sharing, each function would fetch and
+ * decompress the value again.  Plain Vars in the targetlist don't count,
+ * since projection copies their values without evaluating them.
+ */
+static bool
+ExecVarNeedsToastCache(Var *variable, PlanState *parent)
+{
+	count_var_references_context context;
+	ListCell   *lc;
+
+	if (parent == NULL || variable->varlevelsup != 0 ||
+		get_typlen(variable->vartype) != -1)
+		return false;
+
+	context.variable = variable;
+	context.count = 0;
+
+	foreach(lc, parent->plan->targetlist)
+	{
+		TargetEntry *tle = (TargetEntry *) lfirst(lc);
+
+		if (tle->expr != NULL && IsA(tle->expr, Var))
+			continue;
+		(void) count_var_references_walker((Node *) tle->expr, &context);
+	}
+	(void) count_var_references_walker((Node *) parent->plan->qual, &context);
+
+	return context.count > 1;
+}
+
+static bool
+count_var_references_walker(Node *node, count_var_references_context *context)
+{
+	if (node == NULL)
+		return false;
+	if (IsA(node, Var))
+	{
+		Var		   *var = (Var *) node;
+
+		if (var->varno == context->variable->varno &&
+			var->varattno == context->variable->varattno &&
+			var->varlevelsup == 0)
+			context->count++;
+		return false;
+	}
+	return expression_tree_walker(node, count_var_references_walker,
+								  (void *) context);
+}
+
 /*
  * ExecPrepareExpr --- initialize for expression execution outside a normal
  * Plan tree context.
@@ -19,6 +19,7 @@
 #include "postgres.h"
 
 #include "executor/executor.h"
+#include "executor/nodeHashjoin.h"
 #include "miscadmin.h"
 #include "utils/memutils.h"
 
@@ -112,6 +113,7 @@ ExecScan(ScanState *node,
 	ExprContext *econtext;
 	List	   *qual;
 	ProjectionInfo *projInfo;
+	JoinFilterState *joinFilter;
 	ExprDoneCond isDone;
 	TupleTableSlot *resultSlot;
 
@@ -121,12 +123,15 @@ ExecScan(ScanState *node,
 	qual = node->ps.qual;
 	projInfo = node->ps.ps_ProjInfo;
 	econtext = node->ps.ps_ExprContext;
+	joinFilter = node->ss_JoinFilter;
 
 	/*
-	 * If we have neither a qual to check nor a projection to do, just skip
-	 * all the overhead and return the raw scan tuple.
+	 * If we have neither a qual to check nor a projection to do, nor a
+	 * filter pushed down from a hash join to test, just skip all the
+	 * overhead and return the raw scan tuple.
 	 */
-	if (!qual && !projInfo)
+	if (!qual && !projInfo &&
+		(joinFilter == NULL || joinFilter->hashtable == NULL))
 	{
 		ResetExprContext(econtext);
 		return ExecScanFetch(node, accessMtd, recheckMtd);
@@ -185,6 +190,18 @@ ExecScan(ScanState *node,
 		 */
 		econtext->ecxt_scantuple = slot;
 
+		/*
+		 * If a hash join above us has told us which join keys it has, skip
+		 * tuples that can't find a join partner.  (This doesn't count as
+		 * filtering by the qual.)
+		 */
+		if (joinFilter != NULL && joinFilter->hashtable != NULL &&
+			!ExecHashJoinFilterTuple(joinFilter, slot))
+		{
+			ResetExprContext(econtext);
+			continue;
+		}
+
 		/*
 		 * check that the current tuple satisfies the qual-clause
 		 *
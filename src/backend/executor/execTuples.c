@@ -95,6 +95,7 @@
 
 static TupleDesc ExecTypeFromTLInternal(List *targetList,
 					   bool hasoid, bool skipjunk);
+static int	slot_fixed_natts(TupleDesc tupdesc);
 
 
 /* ----------------------------------------------------------------
@@ -124,6 +125,7 @@ MakeTupleTableSlot(void)
 	slot->tts_values = NULL;
 	slot->tts_isnull = NULL;
 	slot->tts_mintuple = NULL;
+	slot->tts_nfixed = 0;
 
 	return slot;
 }
@@ -280,6 +282,41 @@ ExecSetSlotDescriptor(TupleTableSlot *slot,		/* slot to change */
 		MemoryContextAlloc(slot->tts_mcxt, tupdesc->natts * sizeof(Datum));
 	slot->tts_isnull = (bool *)
 		MemoryContextAlloc(slot->tts_mcxt, tupdesc->natts * sizeof(bool));
+
+	slot->tts_nfixed = slot_fixed_natts(tupdesc);
+}
+
+/* --------------------------------
+ *		slot_fixed_natts
+ *
+ *		Count the leading fixed-width attributes of tupdesc, setting their
+ *		attcacheoff along the way exactly as slot_deform_tuple would.
+ *		Their offsets are then known for every tuple without nulls among
+ *		them, so slot_deform_tuple can fetch them in a tight loop.
+ * --------------------------------
+ */
+static int
+slot_fixed_natts(TupleDesc tupdesc)
+{
+	Form_pg_attribute *att = tupdesc->attrs;
+	long		off = 0;
+	int			attnum;
+
+	for (attnum = 0; attnum < tupdesc->natts; attnum++)
+	{
+		Form_pg_attribute thisatt = att[attnum];
+
+		if (thisatt->attlen <= 0)
+			break;
+
+		off = att_align_nominal(off, thisatt->attalign);
+		if (thisatt->attcacheoff < 0)
+			thisatt->attcacheoff = off;
+		Assert(thisatt->attcacheoff == off);
+		off += thisatt->attlen;
+	}
+
+	return attnum;
 }
 
 /* --------------------------------
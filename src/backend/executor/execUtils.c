@@ -16,6 +16,7 @@
  * INTERFACE ROUTINES
  *		CreateExecutorState		Create/delete executor working state
  *		FreeExecutorState
+ *		ExecInitRangeTable		Set up the range table of executor state
  *		CreateExprContext
  *		CreateStandaloneExprContext
  *		FreeExprContext
@@ -38,15 +39,22 @@
 
 #include "postgres.h"
 
+#include "access/parallel.h"
 #include "access/relscan.h"
 #include "access/transam.h"
+#include "catalog/pg_type.h"
 #include "executor/executor.h"
 #include "nodes/nodeFuncs.h"
+#include "optimizer/clauses.h"
+#include "optimizer/predtest.h"
 #include "parser/parsetree.h"
+#include "utils/builtins.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
 
 
+static bool tlist_matches_result_type(List *targetList, bool hasoid,
+						  TupleDesc tupdesc);
 static bool get_last_attnums(Node *node, ProjectionInfo *projInfo);
 static void ShutdownExprContext(ExprContext *econtext, bool isCommit);
 
@@ -99,6 +107,8 @@ CreateExecutorState(void)
 	estate->es_snapshot = InvalidSnapshot;		/* caller must initialize this */
 	estate->es_crosscheck_snapshot = InvalidSnapshot;	/* no crosscheck */
 	estate->es_range_table = NIL;
+	estate->es_range_table_array = NULL;
+	estate->es_range_table_size = 0;
 	estate->es_plannedstmt = NULL;
 
 	estate->es_junkFilter = NULL;
@@ -192,6 +202,34 @@ FreeExecutorState(EState *estate)
 	MemoryContextDelete(estate->es_query_cxt);
 }
 
+/* ----------------
+ *		ExecInitRangeTable
+ *
+ *		Install the range table of the query in an EState.
+ *
+ * Besides the list, we build an array of the entries, so that exec_rt_fetch
+ * can find an entry without walking the list.  With thousands of entries,
+ * as with a big inheritance tree, looking up each scan node's entry with
+ * rt_fetch would take time quadratic in the size of the range table.
+ * ----------------
+ */
+void
+ExecInitRangeTable(EState *estate, List *rangeTable)
+{
+	Index		rti;
+	ListCell   *lc;
+
+	estate->es_range_table = rangeTable;
+	estate->es_range_table_size = list_length(rangeTable);
+	estate->es_range_table_array = (RangeTblEntry **)
+		MemoryContextAlloc(estate->es_query_cxt,
+						   estate->es_range_table_size * sizeof(RangeTblEntry *));
+
+	rti = 0;
+	foreach(lc, rangeTable)
+		estate->es_range_table_array[rti++] = (RangeTblEntry *) lfirst(lc);
+}
+
 /* ----------------
  *		CreateExprContext
  *
@@ -225,13 +263,16 @@ CreateExprContext(EState *estate)
 
 	/*
 	 * Create working memory for expression evaluation in this context.
+	 * Since it's reset for every tuple, pfree'd space needn't be reusable,
+	 * and a bump context serves the allocations more cheaply and densely
+	 * than an AllocSet would.
 	 */
 	econtext->ecxt_per_tuple_memory =
-		AllocSetContextCreate(estate->es_query_cxt,
-							  "ExprContext",
-							  ALLOCSET_DEFAULT_MINSIZE,
-							  ALLOCSET_DEFAULT_INITSIZE,
-							  ALLOCSET_DEFAULT_MAXSIZE);
+		BumpContextCreate(estate->es_query_cxt,
+						  "ExprContext",
+						  ALLOCSET_DEFAULT_MINSIZE,
+						  ALLOCSET_DEFAULT_INITSIZE,
+						  ALLOCSET_DEFAULT_MAXSIZE);
 
 	econtext->ecxt_param_exec_vals = estate->es_param_exec_vals;
 	econtext->ecxt_param_list_info = estate->es_param_list_info;
@@ -249,6 +290,8 @@ CreateExprContext(EState *estate)
 
 	econtext->ecxt_callbacks = NULL;
 
+	econtext->ecxt_toast_values = NIL;
+
 	/*
 	 * Link the ExprContext into the EState to ensure it is shut down when the
 	 * EState is freed.  Because we use lcons(), shutdowns will occur in
@@ -320,6 +363,8 @@ CreateStandaloneExprContext(void)
 
 	econtext->ecxt_callbacks = NULL;
 
+	econtext->ecxt_toast_values = NIL;
+
 	return econtext;
 }
 
@@ -447,6 +492,28 @@ ExecAssignResultTypeFromTL(PlanState *planstate)
 		hasoid = false;
 	}
 
+	/*
+	 * Many nodes (Limit, Sort, Material, Hash and so on) just pass their
+	 * input rows through, with a targetlist copied from their outer plan.
+	 * If the outer plan is already initialized and its result descriptor is
+	 * exactly what we would build, share it; building a descriptor means a
+	 * syscache lookup per column, which adds up in the startup of short
+	 * queries.
+	 */
+	if (outerPlanState(planstate) != NULL &&
+		outerPlanState(planstate)->ps_ResultTupleSlot != NULL)
+	{
+		tupDesc = ExecGetResultType(outerPlanState(planstate));
+
+		if (tupDesc != NULL &&
+			tlist_matches_result_type(planstate->plan->targetlist, hasoid,
+									  tupDesc))
+		{
+			ExecAssignResultType(planstate, tupDesc);
+			return;
+		}
+	}
+
 	/*
 	 * ExecTypeFromTL needs the parse-time representation of the tlist, not a
 	 * list of ExprStates.  This is good because some plan nodes don't bother
@@ -456,6 +523,45 @@ ExecAssignResultTypeFromTL(PlanState *planstate)
 	ExecAssignResultType(planstate, tupDesc);
 }
 
+/*
+ * Does ExecTypeFromTL(targetList, hasoid) produce a descriptor equal to
+ * tupdesc?  We only accept descriptors that ExecTypeFromTL could have built,
+ * i.e. of anonymous record type without constraints.
+ */
+static bool
+tlist_matches_result_type(List *targetList, bool hasoid, TupleDesc tupdesc)
+{
+	int			attrno = 0;
+	ListCell   *tlist;
+
+	if (tupdesc->natts != list_length(targetList) ||
+		tupdesc->tdhasoid != hasoid ||
+		tupdesc->tdtypeid != RECORDOID ||
+		tupdesc->tdtypmod != -1 ||
+		tupdesc->constr != NULL)
+		return false;
+
+	foreach(tlist, targetList)
+	{
+		TargetEntry *tle = (TargetEntry *) lfirst(tlist);
+		Form_pg_attribute att_tup = tupdesc->attrs[attrno++];
+
+		if (att_tup->attisdropped ||
+			att_tup->atttypid != exprType((Node *) tle->expr) ||
+			att_tup->atttypmod != exprTypmod((Node *) tle->expr) ||
+			att_tup->attcollation != exprCollation((Node *) tle->expr) ||
+			att_tup->attndims != 0)
+			return false;
+
+		/* ExecTypeFromTL leaves the name empty if there is no resname */
+		if (namestrcmp(&att_tup->attname,
+					   tle->resname ? tle->resname : "") != 0)
+			return false;
+	}
+
+	return true;
+}
+
 /* ----------------
  *		ExecGetResultType
  * ----------------
@@ -815,8 +921,17 @@ ExecOpenScanRelation(EState *estate, Index scanrelid, int eflags)
 			lockmode = NoLock;
 	}
 
+	/*
+	 * A parallel worker relies on the lock its leader already holds on the
+	 * relation.  Trying to acquire our own could deadlock against the leader
+	 * if it holds a conflicting lock, since it won't release that lock until
+	 * we're done.
+	 */
+	if (IsParallelWorker())
+		lockmode = NoLock;
+
 	/* Open the relation and acquire lock as needed */
-	reloid = getrelid(scanrelid, estate->es_range_table);
+	reloid = exec_rt_fetch(scanrelid, estate)->relid;
 	rel = heap_open(reloid, lockmode);
 
 	/*
@@ -855,6 +970,100 @@ ExecCloseScanRelation(Relation scanrel)
 	heap_close(scanrel, NoLock);
 }
 
+/* ----------------------------------------------------------------
+ *		ExecPruneSubplans
+ *
+ *		Return the subplans of an Append or MergeAppend that must be
+ *		initialized, leaving out those that can't return any rows given
+ *		the values of the query's external Params.
+ *
+ * prunequals and pruneconstrs are the node's lists set up by the planner
+ * (see struct Append).  A subplan is left out if its relation's constraints
+ * are refuted by its restriction clauses once the Params in those have been
+ * replaced by their values, which is the test the planner would have made
+ * if it had known the values.  We always keep at least one subplan, so that
+ * EXPLAIN and ruleutils.c have a child plan to look at.
+ * ----------------------------------------------------------------
+ */
+List *
+ExecPruneSubplans(EState *estate, List *subplans,
+				  List *prunequals, List *pruneconstrs)
+{
+	ParamListInfo params = estate->es_param_list_info;
+	List	   *result = NIL;
+	MemoryContext prunecxt;
+	MemoryContext oldcxt;
+	ListCell   *lcp,
+			   *lcq,
+			   *lcc;
+
+	if (prunequals == NIL || params == NULL)
+		return subplans;
+
+	Assert(list_length(prunequals) == list_length(subplans));
+	Assert(list_length(pruneconstrs) == list_length(subplans));
+
+	/* Do the work in a temporary context, the proofs can leak some memory */
+	prunecxt = AllocSetContextCreate(CurrentMemoryContext,
+									 "ExecPruneSubplans",
+									 ALLOCSET_SMALL_MINSIZE,
+									 ALLOCSET_SMALL_INITSIZE,
+									 ALLOCSET_SMALL_MAXSIZE);
+
+	lcq = list_head(prunequals);
+	lcc = list_head(pruneconstrs);
+	foreach(lcp, subplans)
+	{
+		List	   *quals = (List *) lfirst(lcq);
+		List	   *constraints = (List *) lfirst(lcc);
+		bool		excluded = false;
+
+		if (quals != NIL)
+		{
+			ListCell   *lc;
+
+			oldcxt = MemoryContextSwitchTo(prunecxt);
+
+			quals = (List *) eval_const_expressions_params(params,
+														   (Node *) quals);
+
+			/* A clause that became constant FALSE or NULL excludes all */
+			foreach(lc, quals)
+			{
+				Node	   *qual = (Node *) lfirst(lc);
+
+				if (IsA(qual, Const) &&
+					(((Const *) qual)->constisnull ||
+					 !DatumGetBool(((Const *) qual)->constvalue)))
+				{
+					excluded = true;
+					break;
+				}
+			}
+
+			if (!excluded)
+				excluded = predicate_refuted_by(quals, quals) ||
+					predicate_refuted_by(constraints, quals);
+
+			MemoryContextSwitchTo(oldcxt);
+			MemoryContextReset(prunecxt);
+		}
+
+		if (!excluded)
+			result = lappend(result, lfirst(lcp));
+
+		lcq = lnext(lcq);
+		lcc = lnext(lcc);
+	}
+
+	MemoryContextDelete(prunecxt);
+
+	if (result == NIL)
+		result = list_make1(linitial(subplans));
+
+	return result;
+}
+
 /*
  * UpdateChangedParamSet
  *		Add changed parameters to a plan node's chgParam set
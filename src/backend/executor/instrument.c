@@ -15,13 +15,153 @@
 
 #include <unistd.h>
 
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define USE_INSTR_TSC
+#elif defined(_M_AMD64) && defined(_MSC_VER)
+#include <intrin.h>
+#define USE_INSTR_TSC
+#endif
+
 #include "executor/instrument.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
 
 BufferUsage pgBufferUsage;
+WalUsage	pgWalUsage;
+
+/*
+ * Per-relation buffer usage, collected while pgRelBufferUsageActive is set.
+ * The hash table is keyed by RelFileNode and fork number.
+ */
+bool		pgRelBufferUsageActive = false;
+static HTAB *RelBufferUsageHash = NULL;
 
+/*
+ * The clock used for node timing, chosen by InstrInitClock the first time
+ * timing is requested in this process.  instr_seconds_per_tick is zero until
+ * then.
+ */
+static double instr_seconds_per_tick = 0.0;
+#ifdef USE_INSTR_TSC
+static bool instr_use_tsc = false;
+
+/* How long to measure the TSC against the system clock, if we must */
+#define TSC_CALIBRATION_USEC	2000
+#endif
+
+static void InstrInitClock(void);
 static void BufferUsageAccumDiff(BufferUsage *dst,
 					 const BufferUsage *add, const BufferUsage *sub);
+static void RelBufferUsageReset(void *arg);
+
+
+#ifdef USE_INSTR_TSC
+/* Execute CPUID, returning all zeroes for leaves the CPU doesn't have */
+static void
+instr_cpuid(unsigned int leaf, unsigned int *regs)
+{
+	unsigned int maxleaf;
+#if defined(__GNUC__)
+	unsigned int unused;
+
+	__cpuid(leaf & 0x80000000, maxleaf, unused, unused, unused);
+	if (leaf > maxleaf)
+		regs[0] = regs[1] = regs[2] = regs[3] = 0;
+	else
+		__cpuid(leaf, regs[0], regs[1], regs[2], regs[3]);
+#else
+	int			info[4];
+
+	__cpuid(info, leaf & 0x80000000);
+	maxleaf = (unsigned int) info[0];
+	if (leaf > maxleaf)
+		memset(info, 0, sizeof(info));
+	else
+		__cpuid(info, leaf);
+	memcpy(regs, info, sizeof(info));
+#endif
+}
+#endif   /* USE_INSTR_TSC */
+
+/*
+ * Choose the clock for node timing.
+ *
+ * Reading the time-stamp counter costs a few nanoseconds, where
+ * gettimeofday() can take a microsecond or more on some virtual machines,
+ * which makes EXPLAIN ANALYZE and auto_explain.log_analyze run several times
+ * slower than the query itself.  We only trust the TSC if the CPU says it is
+ * invariant, ie ticks at the same rate on all cores regardless of frequency
+ * scaling and sleep states.  Its rate comes from CPUID where the CPU reports
+ * it, and is otherwise measured against the system clock, once per process.
+ */
+static void
+InstrInitClock(void)
+{
+#ifdef USE_INSTR_TSC
+	unsigned int regs[4];
+
+	instr_use_tsc = false;
+
+	instr_cpuid(0x80000007, regs);
+	if (regs[3] & (1 << 8))
+	{
+		/* leaf 0x15 gives the TSC/crystal ratio and the crystal frequency */
+		instr_cpuid(0x15, regs);
+		if (regs[0] != 0 && regs[1] != 0 && regs[2] != 0)
+		{
+			instr_seconds_per_tick = (double) regs[0] /
+				((double) regs[2] * (double) regs[1]);
+			instr_use_tsc = true;
+		}
+		else
+		{
+			instr_time	start;
+			instr_time	elapsed;
+			uint64		tsc_start;
+			uint64		tsc_end;
 
+			INSTR_TIME_SET_CURRENT(start);
+			tsc_start = __rdtsc();
+			do
+			{
+				INSTR_TIME_SET_CURRENT(elapsed);
+				INSTR_TIME_SUBTRACT(elapsed, start);
+			} while (INSTR_TIME_GET_MICROSEC(elapsed) < TSC_CALIBRATION_USEC);
+			tsc_end = __rdtsc();
+
+			if (tsc_end > tsc_start)
+			{
+				instr_seconds_per_tick = INSTR_TIME_GET_DOUBLE(elapsed) /
+					(double) (tsc_end - tsc_start);
+				instr_use_tsc = true;
+			}
+		}
+	}
+	if (instr_use_tsc)
+		return;
+#endif
+
+	instr_seconds_per_tick = 1.0e-6;
+}
+
+/* Read the clock chosen by InstrInitClock */
+static inline uint64
+InstrGetTicks(void)
+{
+	instr_time	now;
+
+#ifdef USE_INSTR_TSC
+	if (instr_use_tsc)
+		return __rdtsc();
+#endif
+
+	INSTR_TIME_SET_CURRENT(now);
+	return INSTR_TIME_GET_MICROSEC(now);
+}
+
+#define InstrTicksToSeconds(ticks) ((double) (ticks) * instr_seconds_per_tick)
 
 /* Allocate new instrumentation structure(s) */
 Instrumentation *
@@ -42,6 +182,16 @@ InstrAlloc(int n, int instrument_options)
 			instr[i].need_bufusage = need_buffers;
 			instr[i].need_timer = need_timer;
 		}
+
+		if (need_timer && instr_seconds_per_tick == 0.0)
+			InstrInitClock();
+	}
+	if (instrument_options & INSTRUMENT_WAL)
+	{
+		int			i;
+
+		for (i = 0; i < n; i++)
+			instr[i].need_walusage = true;
 	}
 
 	return instr;
@@ -53,8 +203,8 @@ InstrStartNode(Instrumentation *instr)
 {
 	if (instr->need_timer)
 	{
-		if (INSTR_TIME_IS_ZERO(instr->starttime))
-			INSTR_TIME_SET_CURRENT(instr->starttime);
+		if (instr->starttime == 0)
+			instr->starttime = InstrGetTicks();
 		else
 			elog(ERROR, "InstrStartNode called twice in a row");
 	}
@@ -62,27 +212,26 @@ InstrStartNode(Instrumentation *instr)
 	/* save buffer usage totals at node entry, if needed */
 	if (instr->need_bufusage)
 		instr->bufusage_start = pgBufferUsage;
+
+	if (instr->need_walusage)
+		instr->walusage_start = pgWalUsage;
 }
 
 /* Exit from a plan node */
 void
 InstrStopNode(Instrumentation *instr, double nTuples)
 {
-	instr_time	endtime;
-
 	/* count the returned tuples */
 	instr->tuplecount += nTuples;
 
 	/* let's update the time only if the timer was requested */
 	if (instr->need_timer)
 	{
-		if (INSTR_TIME_IS_ZERO(instr->starttime))
+		if (instr->starttime == 0)
 			elog(ERROR, "InstrStopNode called without start");
 
-		INSTR_TIME_SET_CURRENT(endtime);
-		INSTR_TIME_ACCUM_DIFF(instr->counter, endtime, instr->starttime);
-
-		INSTR_TIME_SET_ZERO(instr->starttime);
+		instr->counter += InstrGetTicks() - instr->starttime;
+		instr->starttime = 0;
 	}
 
 	/* Add delta of buffer usage since entry to node's totals */
@@ -90,11 +239,15 @@ InstrStopNode(Instrumentation *instr, double nTuples)
 		BufferUsageAccumDiff(&instr->bufusage,
 							 &pgBufferUsage, &instr->bufusage_start);
 
+	if (instr->need_walusage)
+		WalUsageAccumDiff(&instr->walusage,
+						  &pgWalUsage, &instr->walusage_start);
+
 	/* Is this the first tuple of this cycle? */
 	if (!instr->running)
 	{
 		instr->running = true;
-		instr->firsttuple = INSTR_TIME_GET_DOUBLE(instr->counter);
+		instr->firsttuple = InstrTicksToSeconds(instr->counter);
 	}
 }
 
@@ -108,11 +261,11 @@ InstrEndLoop(Instrumentation *instr)
 	if (!instr->running)
 		return;
 
-	if (!INSTR_TIME_IS_ZERO(instr->starttime))
+	if (instr->starttime != 0)
 		elog(ERROR, "InstrEndLoop called on running node");
 
 	/* Accumulate per-cycle statistics into totals */
-	totaltime = INSTR_TIME_GET_DOUBLE(instr->counter);
+	totaltime = InstrTicksToSeconds(instr->counter);
 
 	instr->startup += instr->firsttuple;
 	instr->total += totaltime;
@@ -121,8 +274,8 @@ InstrEndLoop(Instrumentation *instr)
 
 	/* Reset for next cycle (if any) */
 	instr->running = false;
-	INSTR_TIME_SET_ZERO(instr->starttime);
-	INSTR_TIME_SET_ZERO(instr->counter);
+	instr->starttime = 0;
+	instr->counter = 0;
 	instr->firsttuple = 0;
 	instr->tuplecount = 0;
 }
@@ -133,6 +286,8 @@ BufferUsageAccumDiff(BufferUsage *dst,
 					 const BufferUsage *add,
 					 const BufferUsage *sub)
 {
+	int			i;
+
 	dst->shared_blks_hit += add->shared_blks_hit - sub->shared_blks_hit;
 	dst->shared_blks_read += add->shared_blks_read - sub->shared_blks_read;
 	dst->shared_blks_dirtied += add->shared_blks_dirtied - sub->shared_blks_dirtied;
@@ -147,4 +302,161 @@ BufferUsageAccumDiff(BufferUsage *dst,
 						  add->blk_read_time, sub->blk_read_time);
 	INSTR_TIME_ACCUM_DIFF(dst->blk_write_time,
 						  add->blk_write_time, sub->blk_write_time);
+	INSTR_TIME_ACCUM_DIFF(dst->temp_blk_read_time,
+						  add->temp_blk_read_time, sub->temp_blk_read_time);
+	INSTR_TIME_ACCUM_DIFF(dst->temp_blk_write_time,
+						  add->temp_blk_write_time, sub->temp_blk_write_time);
+	for (i = 0; i < IO_LATENCY_BUCKETS; i++)
+	{
+		dst->blk_read_hist[i] += add->blk_read_hist[i] - sub->blk_read_hist[i];
+		dst->blk_write_hist[i] += add->blk_write_hist[i] - sub->blk_write_hist[i];
+	}
+}
+
+/* dst += add - sub */
+void
+WalUsageAccumDiff(WalUsage *dst, const WalUsage *add, const WalUsage *sub)
+{
+	dst->wal_records += add->wal_records - sub->wal_records;
+	dst->wal_fpi += add->wal_fpi - sub->wal_fpi;
+	dst->wal_bytes += add->wal_bytes - sub->wal_bytes;
+}
+
+/*
+ * Return the latency histogram bucket an I/O taking io_time falls into.
+ */
+int
+InstrIOLatencyBucket(instr_time io_time)
+{
+	uint64		limit = 10;
+	uint64		usec = INSTR_TIME_GET_MICROSEC(io_time);
+	int			bucket;
+
+	for (bucket = 0; bucket < IO_LATENCY_BUCKETS - 1; bucket++)
+	{
+		if (usec < limit)
+			break;
+		limit *= 10;
+	}
+	return bucket;
+}
+
+/*
+ * Return a short description of a latency histogram bucket, for display.
+ */
+const char *
+InstrIOLatencyBucketName(int bucket)
+{
+	static const char *const names[IO_LATENCY_BUCKETS] = {
+		"<10us", "<100us", "<1ms", "<10ms", "<100ms", ">=100ms"
+	};
+
+	Assert(bucket >= 0 && bucket < IO_LATENCY_BUCKETS);
+	return names[bucket];
+}
+
+/*
+ * Start collecting buffer usage per relation fork.
+ *
+ * The counts are kept in CurrentMemoryContext, and collection stops by
+ * itself when that context goes away, e.g. on error.  Returns false if
+ * collection was already active, in which case the caller must not call
+ * InstrEndRelBufferUsage.
+ */
+bool
+InstrStartRelBufferUsage(void)
+{
+	HASHCTL		ctl;
+	MemoryContextCallback *cb;
+
+	if (RelBufferUsageHash != NULL)
+		return false;
+
+	MemSet(&ctl, 0, sizeof(ctl));
+	ctl.keysize = offsetof(RelBufferUsage, blks_hit);
+	ctl.entrysize = sizeof(RelBufferUsage);
+	ctl.hcxt = CurrentMemoryContext;
+	RelBufferUsageHash = hash_create("relation buffer usage", 64, &ctl,
+									 HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	cb = (MemoryContextCallback *) palloc(sizeof(MemoryContextCallback));
+	cb->func = RelBufferUsageReset;
+	cb->arg = RelBufferUsageHash;
+	MemoryContextRegisterResetCallback(CurrentMemoryContext, cb);
+
+	pgRelBufferUsageActive = true;
+	return true;
+}
+
+/*
+ * Stop collecting buffer usage per relation fork, and return the counts
+ * as a palloc'd array, storing the number of entries into *nentries.
+ */
+RelBufferUsage *
+InstrEndRelBufferUsage(int *nentries)
+{
+	RelBufferUsage *result;
+	RelBufferUsage *entry;
+	HASH_SEQ_STATUS status;
+	int			n = 0;
+
+	Assert(RelBufferUsageHash != NULL);
+
+	result = (RelBufferUsage *)
+		palloc(Max(hash_get_num_entries(RelBufferUsageHash), 1) *
+			   sizeof(RelBufferUsage));
+	hash_seq_init(&status, RelBufferUsageHash);
+	while ((entry = (RelBufferUsage *) hash_seq_search(&status)) != NULL)
+		result[n++] = *entry;
+
+	hash_destroy(RelBufferUsageHash);
+	RelBufferUsageReset(RelBufferUsageHash);
+
+	*nentries = n;
+	return result;
+}
+
+/*
+ * Add to the buffer usage of a relation fork.  io_time is the time spent
+ * reading, or NULL if not measured.
+ */
+void
+InstrCountRelBuffers(RelFileNode rnode, ForkNumber forknum,
+					 long hits, long reads, instr_time *io_time)
+{
+	RelBufferUsage key;
+	RelBufferUsage *entry;
+	bool		found;
+
+	Assert(pgRelBufferUsageActive);
+
+	MemSet(&key, 0, offsetof(RelBufferUsage, blks_hit));
+	key.rnode = rnode;
+	key.forknum = forknum;
+	entry = (RelBufferUsage *) hash_search(RelBufferUsageHash, &key,
+										   HASH_ENTER, &found);
+	if (!found)
+	{
+		entry->blks_hit = 0;
+		entry->blks_read = 0;
+		INSTR_TIME_SET_ZERO(entry->blk_read_time);
+	}
+	entry->blks_hit += hits;
+	entry->blks_read += reads;
+	if (io_time)
+		INSTR_TIME_ADD(entry->blk_read_time, *io_time);
+}
+
+/*
+ * Stop collecting per-relation buffer usage into the given hash table, if
+ * it is still the active one.  Also used as a memory context callback.
+ */
+static void
+RelBufferUsageReset(void *arg)
+{
+	if (RelBufferUsageHash == (HTAB *) arg)
+	{
+		RelBufferUsageHash = NULL;
+		pgRelBufferUsageActive = false;
+	}
 }
@@ -88,6 +88,16 @@
  *	  need some fallback logic to use this, since there's no Aggref node
  *	  for a window function.)
  *
+ *	  Partial aggregation:
+ *
+ *	  To support parallel query, an aggregate can be computed in two stages.
+ *	  An Agg with finalizeAggs = false skips the finalfunc and emits the raw
+ *	  transition values; an Agg with combineStates = true expects its input
+ *	  to contain such transition values and merges them using the
+ *	  aggregate's combinefunc in place of its transfunc.  The planner is
+ *	  responsible for only doing this for aggregates that have a combinefunc
+ *	  and a transition type that can be passed between processes.
+ *
  *	  Grouping sets:
  *
  *	  A list of grouping sets which is structurally equivalent to a ROLLUP
@@ -117,7 +127,28 @@
  *	  sensitive to the grouping set for which the aggregate function is
  *	  currently being called.
  *
- *	  TODO: AGG_HASHED doesn't support multiple grouping sets yet.
+ *	  In AGG_HASHED mode, grouping sets are instead processed in a single pass
+ *	  over unordered input by keeping a separate hash table for each grouping
+ *	  set; each input tuple is looked up in all of them.  The planner passes
+ *	  the additional sets as a chain of Agg nodes without Sort nodes below
+ *	  them, each with a single grouping set covering all of its columns.  An
+ *	  empty grouping set simply gets a hash table with no key columns, which
+ *	  must be given its one group explicitly if the input turns out empty.
+ *
+ *	  Spilling hashed aggregation:
+ *
+ *	  In AGG_HASHED mode the hash table normally holds every group of the
+ *	  input at once.  The planner only chooses hashing if it expects the
+ *	  table to fit in work_mem, but its estimate of the number of groups can
+ *	  be badly wrong, so once the table does outgrow work_mem we stop adding
+ *	  groups to it.  Input tuples of groups already in the table are still
+ *	  aggregated as usual, but all others are written to temporary files,
+ *	  partitioned by their hash value.  When the groups in the table have
+ *	  been returned, the table is emptied and each partition in turn is read
+ *	  back as if it were the input, spilling again if it still has too many
+ *	  groups.  Every pass finishes at least one group, so this terminates
+ *	  however many groups there are; and since a group is never split
+ *	  between passes, each one is still aggregated and finalized just once.
  *
  * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
  * Portions Copyright (c) 1994, Regents of the University of California
@@ -130,6 +161,7 @@
 
 #include "postgres.h"
 
+#include "access/hash.h"
 #include "access/htup_details.h"
 #include "catalog/objectaccess.h"
 #include "catalog/pg_aggregate.h"
@@ -142,8 +174,10 @@
 #include "optimizer/tlist.h"
 #include "parser/parse_agg.h"
 #include "parser/parse_coerce.h"
+#include "storage/buffile.h"
 #include "utils/acl.h"
 #include "utils/builtins.h"
+#include "utils/dynahash.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/syscache.h"
@@ -343,6 +377,28 @@ typedef struct AggStatePerPhaseData
 	Sort	   *sortnode;		/* Sort node for input ordering for phase */
 }	AggStatePerPhaseData;
 
+/*
+ * AggStatePerHashData - per-hashtable state
+ *
+ * In AGG_HASHED mode there is one hash table per grouping set, all filled
+ * in the same pass over the input (just one, if there are no grouping
+ * sets).  The first grouping set is described by the Agg node itself, any
+ * others by the Agg nodes in its chain; each of those carries the grouping
+ * columns and operators of its own set.
+ */
+typedef struct AggStatePerHashData
+{
+	TupleHashTable hashtable;	/* hash table with one entry per group */
+	TupleHashIterator hashiter; /* for iterating through hash table */
+	TupleTableSlot *hashslot;	/* slot for loading hash table */
+	List	   *hash_needed;	/* list of columns needed in hash table */
+	FmgrInfo   *hashfunctions;	/* per-grouping-field hash fns */
+	FmgrInfo   *eqfunctions;	/* per-grouping-field equality fns */
+	Agg		   *aggnode;		/* Agg node describing this grouping set */
+	int			npartitions;	/* # of spill files for current pass */
+	BufFile   **spill_files;	/* spill files for current pass, or NULL */
+}	AggStatePerHashData;
+
 /*
  * To implement hashed aggregation, we need a hashtable that stores a
  * representative tuple and an array of AggStatePerGroup structs for each
@@ -358,6 +414,27 @@ typedef struct AggHashEntryData
 	AggStatePerGroupData pergroup[FLEXIBLE_ARRAY_MEMBER];
 }	AggHashEntryData;
 
+/*
+ * A partition of the input of a hashed aggregation that was written out to
+ * a temporary file because its groups didn't fit in the hash table.  The
+ * file holds the hash value and then the MinimalTuple of each input tuple,
+ * in the same format nodeHashjoin.c uses for its batch files.
+ */
+typedef struct AggSpillPartition
+{
+	BufFile    *file;			/* file holding the spilled tuples */
+	int			setno;			/* grouping set they were spilled for */
+	int			level;			/* # of times these tuples were spilled */
+} AggSpillPartition;
+
+/*
+ * The number of files each pass spills to is chosen between these bounds,
+ * and is further limited so that the files' buffers stay well below
+ * work_mem.
+ */
+#define HASHAGG_MIN_PARTITIONS 4
+#define HASHAGG_MAX_PARTITIONS 256
+
 
 static void initialize_phase(AggState *aggstate, int newphase);
 static TupleTableSlot *fetch_input_tuple(AggState *aggstate);
@@ -368,7 +445,8 @@ static void initialize_aggregates(AggState *aggstate,
 static void advance_transition_function(AggState *aggstate,
 							AggStatePerAgg peraggstate,
 							AggStatePerGroup pergroupstate);
-static void advance_aggregates(AggState *aggstate, AggStatePerGroup pergroup);
+static void advance_aggregates(AggState *aggstate, AggStatePerGroup pergroup,
+				   AggStatePerGroup *hashpergroups);
 static void process_ordered_aggregate_single(AggState *aggstate,
 								 AggStatePerAgg peraggstate,
 								 AggStatePerGroup pergroupstate);
@@ -389,9 +467,22 @@ static void finalize_aggregates(AggState *aggstate,
 static TupleTableSlot *project_aggregates(AggState *aggstate);
 static Bitmapset *find_unaggregated_cols(AggState *aggstate);
 static bool find_unaggregated_cols_walker(Node *node, Bitmapset **colnos);
-static void build_hash_table(AggState *aggstate);
-static AggHashEntry lookup_hash_entry(AggState *aggstate,
+static void build_hash_table(AggState *aggstate, int setno);
+static List *find_hash_columns(AggState *aggstate, int setno);
+static AggHashEntry lookup_hash_entry(AggState *aggstate, int setno,
 				  TupleTableSlot *inputslot);
+static void hash_agg_check_limit(AggState *aggstate);
+static void hash_agg_enter_spill_mode(AggState *aggstate);
+static uint32 hash_agg_hash_tuple(AggState *aggstate, int setno,
+					TupleTableSlot *slot);
+static void hash_agg_spill_tuple(AggState *aggstate, int setno,
+					 TupleTableSlot *slot, uint32 hashvalue);
+static TupleTableSlot *hash_agg_read_spilled_tuple(AggState *aggstate,
+							uint32 *hashvalue);
+static void hash_agg_finish_pass(AggState *aggstate);
+static void hash_agg_begin_iteration(AggState *aggstate, int setno);
+static void hash_agg_next_partition(AggState *aggstate);
+static void hash_agg_reset_spill_state(AggState *aggstate);
 static TupleTableSlot *agg_retrieve_direct(AggState *aggstate);
 static void agg_fill_hash_table(AggState *aggstate);
 static TupleTableSlot *agg_retrieve_hash_table(AggState *aggstate);
@@ -720,13 +811,19 @@ advance_transition_function(AggState *aggstate,
 /*
  * Advance all the aggregates for one input tuple.  The input tuple
  * has been stored in tmpcontext->ecxt_outertuple, so that it is accessible
- * to ExecEvalExpr.  pergroup is the array of per-group structs to use
- * (this might be in a hashtable entry).
+ * to ExecEvalExpr.
+ *
+ * In sorted and plain mode, pergroup is the array of per-group structs to
+ * use, for all grouping sets of the current phase.  In hashed mode,
+ * hashpergroups instead has a pointer to the per-group structs of each
+ * grouping set, which are in the hashtable entries; a NULL pointer means the
+ * tuple's group in that set is not in memory and the set must be skipped.
  *
  * When called, CurrentMemoryContext should be the per-query context.
  */
 static void
-advance_aggregates(AggState *aggstate, AggStatePerGroup pergroup)
+advance_aggregates(AggState *aggstate, AggStatePerGroup pergroup,
+				   AggStatePerGroup *hashpergroups)
 {
 	int			aggno;
 	int			setno = 0;
@@ -779,6 +876,9 @@ advance_aggregates(AggState *aggstate, AggStatePerGroup pergroup)
 					continue;
 			}
 
+			/* hashed aggregation doesn't support these */
+			Assert(pergroup != NULL);
+
 			for (setno = 0; setno < numGroupingSets; setno++)
 			{
 				/* OK, put the tuple into the tuplesort object */
@@ -804,13 +904,29 @@ advance_aggregates(AggState *aggstate, AggStatePerGroup pergroup)
 				fcinfo->argnull[i + 1] = slot->tts_isnull[i];
 			}
 
-			for (setno = 0; setno < numGroupingSets; setno++)
+			if (pergroup != NULL)
 			{
-				AggStatePerGroup pergroupstate = &pergroup[aggno + (setno * numAggs)];
+				for (setno = 0; setno < numGroupingSets; setno++)
+				{
+					AggStatePerGroup pergroupstate = &pergroup[aggno + (setno * numAggs)];
 
-				aggstate->current_set = setno;
+					aggstate->current_set = setno;
 
-				advance_transition_function(aggstate, peraggstate, pergroupstate);
+					advance_transition_function(aggstate, peraggstate, pergroupstate);
+				}
+			}
+			else
+			{
+				for (setno = 0; setno < aggstate->numhashes; setno++)
+				{
+					if (hashpergroups[setno] == NULL)
+						continue;
+
+					aggstate->current_set = setno;
+
+					advance_transition_function(aggstate, peraggstate,
+												&hashpergroups[setno][aggno]);
+				}
 			}
 		}
 	}
@@ -1182,17 +1298,21 @@ finalize_aggregates(AggState *aggstate,
 	bool	   *aggnulls = econtext->ecxt_aggnulls;
 	int			aggno;
 
-	Assert(currentSet == 0 ||
-		   ((Agg *) aggstate->ss.ps.plan)->aggstrategy != AGG_HASHED);
-
 	aggstate->current_set = currentSet;
 
+	/*
+	 * In hashed mode, each hashtable entry holds the states of just one
+	 * grouping set; otherwise, pergroup has the states of all of them.
+	 */
+	if (((Agg *) aggstate->ss.ps.plan)->aggstrategy != AGG_HASHED)
+		pergroup += currentSet * aggstate->numaggs;
+
 	for (aggno = 0; aggno < aggstate->numaggs; aggno++)
 	{
 		AggStatePerAgg peraggstate = &peragg[aggno];
 		AggStatePerGroup pergroupstate;
 
-		pergroupstate = &pergroup[aggno + (currentSet * (aggstate->numaggs))];
+		pergroupstate = &pergroup[aggno];
 
 		if (peraggstate->numSortCols > 0)
 		{
@@ -1294,31 +1414,33 @@ find_unaggregated_cols_walker(Node *node, Bitmapset **colnos)
 }
 
 /*
- * Initialize the hash table to empty.
+ * Initialize the hash table of one grouping set to empty.
  *
- * The hash table always lives in the aggcontext memory context.
+ * The hash table always lives in the aggcontext memory context of its
+ * grouping set.
  */
 static void
-build_hash_table(AggState *aggstate)
+build_hash_table(AggState *aggstate, int setno)
 {
-	Agg		   *node = (Agg *) aggstate->ss.ps.plan;
+	AggStatePerHash perhash = &aggstate->perhash[setno];
+	Agg		   *aggnode = perhash->aggnode;
 	MemoryContext tmpmem = aggstate->tmpcontext->ecxt_per_tuple_memory;
 	Size		entrysize;
 
-	Assert(node->aggstrategy == AGG_HASHED);
-	Assert(node->numGroups > 0);
+	Assert(aggnode->aggstrategy == AGG_HASHED);
+	Assert(aggnode->numGroups > 0);
 
 	entrysize = offsetof(AggHashEntryData, pergroup) +
 		aggstate->numaggs * sizeof(AggStatePerGroupData);
 
-	aggstate->hashtable = BuildTupleHashTable(node->numCols,
-											  node->grpColIdx,
-											  aggstate->phase->eqfunctions,
-											  aggstate->hashfunctions,
-											  node->numGroups,
-											  entrysize,
-							 aggstate->aggcontexts[0]->ecxt_per_tuple_memory,
-											  tmpmem);
+	perhash->hashtable = BuildTupleHashTable(aggnode->numCols,
+											 aggnode->grpColIdx,
+											 perhash->eqfunctions,
+											 perhash->hashfunctions,
+											 aggnode->numGroups,
+											 entrysize,
+						 aggstate->aggcontexts[setno]->ecxt_per_tuple_memory,
+											 tmpmem);
 }
 
 /*
@@ -1347,9 +1469,9 @@ build_hash_table(AggState *aggstate)
  * haven't been explicitly grouped by.
  */
 static List *
-find_hash_columns(AggState *aggstate)
+find_hash_columns(AggState *aggstate, int setno)
 {
-	Agg		   *node = (Agg *) aggstate->ss.ps.plan;
+	Agg		   *aggnode = aggstate->perhash[setno].aggnode;
 	Bitmapset  *colnos;
 	List	   *collist;
 	int			i;
@@ -1357,8 +1479,8 @@ find_hash_columns(AggState *aggstate)
 	/* Find Vars that will be needed in tlist and qual */
 	colnos = find_unaggregated_cols(aggstate);
 	/* Add in all the grouping columns */
-	for (i = 0; i < node->numCols; i++)
-		colnos = bms_add_member(colnos, node->grpColIdx[i]);
+	for (i = 0; i < aggnode->numCols; i++)
+		colnos = bms_add_member(colnos, aggnode->grpColIdx[i]);
 	/* Convert to list, using lcons so largest element ends up first */
 	collist = NIL;
 	while ((i = bms_first_member(colnos)) >= 0)
@@ -1389,30 +1511,28 @@ hash_agg_entry_size(int numAggs)
 }
 
 /*
- * Find or create a hashtable entry for the tuple group containing the
- * given tuple.
+ * Find or create the entry for the tuple group containing the given tuple in
+ * the hashtable of one grouping set.
+ *
+ * Once the tables have outgrown work_mem, no new entries are created; if the
+ * tuple doesn't belong to one of the groups already in the table, NULL is
+ * returned and the caller must spill the tuple.
  *
  * When called, CurrentMemoryContext should be the per-query context.
  */
 static AggHashEntry
-lookup_hash_entry(AggState *aggstate, TupleTableSlot *inputslot)
+lookup_hash_entry(AggState *aggstate, int setno, TupleTableSlot *inputslot)
 {
-	TupleTableSlot *hashslot = aggstate->hashslot;
+	AggStatePerHash perhash = &aggstate->perhash[setno];
+	TupleTableSlot *hashslot = perhash->hashslot;
 	ListCell   *l;
 	AggHashEntry entry;
 	bool		isnew;
-
-	/* if first time through, initialize hashslot by cloning input slot */
-	if (hashslot->tts_tupleDescriptor == NULL)
-	{
-		ExecSetSlotDescriptor(hashslot, inputslot->tts_tupleDescriptor);
-		/* Make sure all unused columns are NULLs */
-		ExecStoreAllNullTuple(hashslot);
-	}
+	int			aggno;
 
 	/* transfer just the needed columns into hashslot */
-	slot_getsomeattrs(inputslot, linitial_int(aggstate->hash_needed));
-	foreach(l, aggstate->hash_needed)
+	slot_getsomeattrs(inputslot, linitial_int(perhash->hash_needed));
+	foreach(l, perhash->hash_needed)
 	{
 		int			varNumber = lfirst_int(l) - 1;
 
@@ -1421,19 +1541,397 @@ lookup_hash_entry(AggState *aggstate, TupleTableSlot *inputslot)
 	}
 
 	/* find or create the hashtable entry using the filtered tuple */
-	entry = (AggHashEntry) LookupTupleHashEntry(aggstate->hashtable,
+	if (aggstate->hash_spill_mode)
+		return (AggHashEntry) LookupTupleHashEntry(perhash->hashtable,
+												   hashslot,
+												   NULL);
+
+	entry = (AggHashEntry) LookupTupleHashEntry(perhash->hashtable,
 												hashslot,
 												&isnew);
 
 	if (isnew)
 	{
 		/* initialize aggregates for new tuple group */
-		initialize_aggregates(aggstate, aggstate->peragg, entry->pergroup, 0);
+		aggstate->current_set = setno;
+		for (aggno = 0; aggno < aggstate->numaggs; aggno++)
+			initialize_aggregate(aggstate, &aggstate->peragg[aggno],
+								 &entry->pergroup[aggno]);
+
+		/* and see whether the tables are full now */
+		hash_agg_check_limit(aggstate);
 	}
 
 	return entry;
 }
 
+/*
+ * Check whether the hash tables, including the transition values of their
+ * groups, have grown beyond work_mem, and if so stop adding groups to them.
+ *
+ * Existing groups can still grow afterwards, if their transition values are
+ * pass-by-reference, but that is not something we can do anything about.
+ */
+static void
+hash_agg_check_limit(AggState *aggstate)
+{
+	Size		mem = 0;
+	int			setno;
+
+	for (setno = 0; setno < aggstate->numhashes; setno++)
+		mem += MemoryContextMemAllocated(aggstate->aggcontexts[setno]->ecxt_per_tuple_memory,
+										 true);
+	if (mem > aggstate->hash_mem_peak)
+		aggstate->hash_mem_peak = mem;
+
+	if (mem > aggstate->hash_mem_limit)
+		hash_agg_enter_spill_mode(aggstate);
+}
+
+/*
+ * Start spilling the input tuples of groups that are not in the hash tables.
+ *
+ * We don't know how many groups remain, but we do know how many fitted, so
+ * if the planner's estimate of the total is still above that, use it to
+ * choose a number of partitions that will probably fit in memory on the next
+ * pass.  If it doesn't, the partitions are split further then.
+ */
+static void
+hash_agg_enter_spill_mode(AggState *aggstate)
+{
+	double		ngroups_est = 0;
+	double		ngroups_mem = 0;
+	double		npartitions;
+	int			max_partitions;
+	int			setno;
+
+	Assert(!aggstate->hash_spill_mode);
+
+	for (setno = 0; setno < aggstate->numhashes; setno++)
+	{
+		AggStatePerHash perhash = &aggstate->perhash[setno];
+
+		if (aggstate->hash_pass_set >= 0 && aggstate->hash_pass_set != setno)
+			continue;
+		ngroups_est += perhash->aggnode->numGroups;
+		ngroups_mem += TupleHashTableEntries(perhash->hashtable);
+	}
+	ngroups_mem = Max(ngroups_mem, 1);
+
+	npartitions = HASHAGG_MIN_PARTITIONS;
+	if (aggstate->hash_spill_level == 0 && ngroups_est > ngroups_mem)
+		npartitions = Max(npartitions, ngroups_est / ngroups_mem - 1);
+
+	/*
+	 * Leave most of work_mem for the hash tables, not the file buffers.
+	 * Every grouping set being read may need its own set of spill files.
+	 */
+	max_partitions = (work_mem * 1024L) / (4 * BLCKSZ);
+	if (aggstate->hash_pass_set < 0)
+		max_partitions /= aggstate->numhashes;
+	max_partitions = Max(max_partitions, HASHAGG_MIN_PARTITIONS);
+	max_partitions = Min(max_partitions, HASHAGG_MAX_PARTITIONS);
+	npartitions = Min(npartitions, max_partitions);
+
+	aggstate->hash_spill_mode = true;
+	aggstate->hash_spilled = true;
+
+	for (setno = 0; setno < aggstate->numhashes; setno++)
+	{
+		AggStatePerHash perhash = &aggstate->perhash[setno];
+
+		if (aggstate->hash_pass_set >= 0 && aggstate->hash_pass_set != setno)
+			continue;
+		perhash->npartitions = 1 << my_log2((long) npartitions);
+		perhash->spill_files = (BufFile **)
+			palloc0(perhash->npartitions * sizeof(BufFile *));
+	}
+}
+
+/*
+ * Compute the hash value of the grouping columns of a tuple for one
+ * grouping set, the same way the tuple hash table does.
+ */
+static uint32
+hash_agg_hash_tuple(AggState *aggstate, int setno, TupleTableSlot *slot)
+{
+	AggStatePerHash perhash = &aggstate->perhash[setno];
+	Agg		   *aggnode = perhash->aggnode;
+	uint32		hashkey = 0;
+	int			i;
+
+	for (i = 0; i < aggnode->numCols; i++)
+	{
+		Datum		attr;
+		bool		isNull;
+
+		/* rotate hashkey left 1 bit at each step */
+		hashkey = (hashkey << 1) | ((hashkey & 0x80000000) ? 1 : 0);
+
+		attr = slot_getattr(slot, aggnode->grpColIdx[i], &isNull);
+
+		if (!isNull)			/* treat nulls as having hash key 0 */
+			hashkey ^= DatumGetUInt32(FunctionCall1(&perhash->hashfunctions[i],
+													attr));
+	}
+
+	return hashkey;
+}
+
+/*
+ * Write an input tuple whose group is not in the hash table of the given
+ * grouping set to that set's spill file for its partition.
+ *
+ * Tuples that have been spilled before are partitioned on a different mix
+ * of their hash value each time, so that the groups of one partition are
+ * spread across all partitions of the next level.
+ *
+ * Like ExecHashJoinSaveTuple, this must be called in the per-query context,
+ * for the sake of the file buffers.
+ */
+static void
+hash_agg_spill_tuple(AggState *aggstate, int setno, TupleTableSlot *slot,
+					 uint32 hashvalue)
+{
+	AggStatePerHash perhash = &aggstate->perhash[setno];
+	MinimalTuple tuple = ExecFetchSlotMinimalTuple(slot);
+	uint32		partbits;
+	int			partition;
+	BufFile    *file;
+	size_t		written;
+
+	partbits = DatumGetUInt32(hash_uint32(hashvalue ^
+										  (uint32) aggstate->hash_spill_level));
+	partition = partbits & (perhash->npartitions - 1);
+
+	file = perhash->spill_files[partition];
+	if (file == NULL)
+	{
+		file = BufFileCreateTempExtended(false, BUFFILE_COMPRESS);
+		perhash->spill_files[partition] = file;
+	}
+
+	written = BufFileWrite(file, (void *) &hashvalue, sizeof(uint32));
+	if (written != sizeof(uint32))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write to hash-agg temporary file: %m")));
+
+	written = BufFileWrite(file, (void *) tuple, tuple->t_len);
+	if (written != tuple->t_len)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write to hash-agg temporary file: %m")));
+}
+
+/*
+ * Read the next tuple from the partition being processed.  Returns NULL at
+ * the end of the file; otherwise, the tuple is stored in hash_spill_slot and
+ * its hash value in *hashvalue.
+ */
+static TupleTableSlot *
+hash_agg_read_spilled_tuple(AggState *aggstate, uint32 *hashvalue)
+{
+	BufFile    *file = aggstate->hash_input_file;
+	TupleTableSlot *slot = aggstate->hash_spill_slot;
+	uint32		header[2];
+	size_t		nread;
+	MinimalTuple tuple;
+
+	/*
+	 * Since both the hash value and the MinimalTuple length word are uint32,
+	 * we can read them both in one BufFileRead() call.
+	 */
+	nread = BufFileRead(file, (void *) header, sizeof(header));
+	if (nread == 0)				/* end of file */
+		return ExecClearTuple(slot);
+	if (nread != sizeof(header))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read from hash-agg temporary file: %m")));
+	*hashvalue = header[0];
+	tuple = (MinimalTuple) palloc(header[1]);
+	tuple->t_len = header[1];
+	nread = BufFileRead(file,
+						(void *) ((char *) tuple + sizeof(uint32)),
+						header[1] - sizeof(uint32));
+	if (nread != header[1] - sizeof(uint32))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read from hash-agg temporary file: %m")));
+	return ExecStoreMinimalTuple(tuple, slot, true);
+}
+
+/*
+ * Finish up after reading all of the input of a pass: queue the partitions
+ * it spilled for processing, and release the partition it read, if any.
+ *
+ * This is also where the empty grouping set gets its group if the input
+ * was empty, since like plain aggregation it must produce a row anyway.
+ */
+static void
+hash_agg_finish_pass(AggState *aggstate)
+{
+	int			setno;
+	int			i;
+
+	for (setno = 0; setno < aggstate->numhashes; setno++)
+	{
+		AggStatePerHash perhash = &aggstate->perhash[setno];
+
+		if (aggstate->hash_pass_set >= 0 && aggstate->hash_pass_set != setno)
+			continue;
+
+		if (perhash->aggnode->numCols == 0 && perhash->spill_files == NULL &&
+			TupleHashTableEntries(perhash->hashtable) == 0)
+		{
+			AggHashEntry entry;
+			bool		isnew;
+			int			aggno;
+
+			ExecStoreAllNullTuple(perhash->hashslot);
+			entry = (AggHashEntry) LookupTupleHashEntry(perhash->hashtable,
+														perhash->hashslot,
+														&isnew);
+			aggstate->current_set = setno;
+			for (aggno = 0; aggno < aggstate->numaggs; aggno++)
+				initialize_aggregate(aggstate, &aggstate->peragg[aggno],
+									 &entry->pergroup[aggno]);
+		}
+
+		for (i = 0; i < perhash->npartitions; i++)
+		{
+			AggSpillPartition *partition;
+
+			if (perhash->spill_files[i] == NULL)
+				continue;
+
+			/*
+			 * Put the new partitions at the front of the queue, so that they
+			 * are processed before the remaining partitions of the previous
+			 * level.  That keeps down the amount of data on disk at any one
+			 * time.
+			 */
+			partition = (AggSpillPartition *) palloc(sizeof(AggSpillPartition));
+			partition->file = perhash->spill_files[i];
+			partition->setno = setno;
+			partition->level = aggstate->hash_spill_level + 1;
+			aggstate->hash_pending = lcons(partition, aggstate->hash_pending);
+		}
+
+		if (perhash->spill_files)
+			pfree(perhash->spill_files);
+		perhash->spill_files = NULL;
+		perhash->npartitions = 0;
+	}
+	aggstate->hash_spill_mode = false;
+
+	if (aggstate->hash_input_file)
+		BufFileClose(aggstate->hash_input_file);
+	aggstate->hash_input_file = NULL;
+}
+
+/*
+ * Start returning the groups of the given grouping set's hash table.
+ */
+static void
+hash_agg_begin_iteration(AggState *aggstate, int setno)
+{
+	AggStatePerHash perhash = &aggstate->perhash[setno];
+
+	aggstate->hash_iter_set = setno;
+	ResetTupleHashIterator(perhash->hashtable, &perhash->hashiter);
+}
+
+/*
+ * Empty the hash table of the next spilled partition's grouping set, and
+ * fill it again from the partition.
+ */
+static void
+hash_agg_next_partition(AggState *aggstate)
+{
+	AggSpillPartition *partition;
+	int			setno;
+	int			i;
+
+	Assert(aggstate->hash_pending != NIL);
+	partition = (AggSpillPartition *) linitial(aggstate->hash_pending);
+	aggstate->hash_pending = list_delete_first(aggstate->hash_pending);
+	setno = partition->setno;
+
+	/*
+	 * All groups in memory have been returned by now, so release all the
+	 * hash tables; only the one for this partition's grouping set is needed
+	 * again.  The representative tuple in the scan slot lives in a hash
+	 * table, so forget it first.  We have to rescan the aggcontexts rather
+	 * than just reset them, since transfns may have registered callbacks
+	 * that need to be run now.
+	 */
+	ExecClearTuple(aggstate->ss.ss_ScanTupleSlot);
+	for (i = 0; i < aggstate->numhashes; i++)
+	{
+		ReScanExprContext(aggstate->aggcontexts[i]);
+		aggstate->perhash[i].hashtable = NULL;
+	}
+	build_hash_table(aggstate, setno);
+
+	if (BufFileSeek(partition->file, 0, 0L, SEEK_SET))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not rewind hash-agg temporary file: %m")));
+	aggstate->hash_input_file = partition->file;
+	aggstate->hash_pass_set = setno;
+	aggstate->hash_spill_level = partition->level;
+	pfree(partition);
+
+	agg_fill_hash_table(aggstate);
+}
+
+/*
+ * Close all temporary files of a spilled hashed aggregation, and reset
+ * the state to start over with the first pass.
+ */
+static void
+hash_agg_reset_spill_state(AggState *aggstate)
+{
+	ListCell   *lc;
+	int			setno;
+	int			i;
+
+	for (setno = 0; setno < aggstate->numhashes; setno++)
+	{
+		AggStatePerHash perhash = &aggstate->perhash[setno];
+
+		for (i = 0; i < perhash->npartitions; i++)
+		{
+			if (perhash->spill_files[i])
+				BufFileClose(perhash->spill_files[i]);
+		}
+		if (perhash->spill_files)
+			pfree(perhash->spill_files);
+		perhash->spill_files = NULL;
+		perhash->npartitions = 0;
+	}
+	aggstate->hash_spill_mode = false;
+
+	foreach(lc, aggstate->hash_pending)
+	{
+		AggSpillPartition *partition = (AggSpillPartition *) lfirst(lc);
+
+		BufFileClose(partition->file);
+	}
+	list_free_deep(aggstate->hash_pending);
+	aggstate->hash_pending = NIL;
+
+	if (aggstate->hash_input_file)
+		BufFileClose(aggstate->hash_input_file);
+	aggstate->hash_input_file = NULL;
+
+	aggstate->hash_pass_set = -1;
+	aggstate->hash_spill_level = 0;
+	aggstate->hash_spilled = false;
+}
+
 /*
  * ExecAgg -
  *
@@ -1741,7 +2239,7 @@ agg_retrieve_direct(AggState *aggstate)
 				 */
 				for (;;)
 				{
-					advance_aggregates(aggstate, pergroup);
+					advance_aggregates(aggstate, pergroup, NULL);
 
 					/* Reset per-input-tuple context after each tuple */
 					ResetExprContext(tmpcontext);
@@ -1817,14 +2315,19 @@ agg_retrieve_direct(AggState *aggstate)
 }
 
 /*
- * ExecAgg for hashed case: phase 1, read input and build hash table
+ * ExecAgg for hashed case: phase 1, read input and build hash tables
+ *
+ * The input is either the outer plan, or in later passes a partition that
+ * an earlier pass spilled for one of the grouping sets.
  */
 static void
 agg_fill_hash_table(AggState *aggstate)
 {
 	ExprContext *tmpcontext;
-	AggHashEntry entry;
+	AggStatePerGroup *pergroups = aggstate->hash_pergroups;
 	TupleTableSlot *outerslot;
+	uint32		hashvalue = 0;
+	int			setno;
 
 	/*
 	 * get state info from node
@@ -1839,29 +2342,58 @@ agg_fill_hash_table(AggState *aggstate)
 	 */
 	for (;;)
 	{
-		outerslot = fetch_input_tuple(aggstate);
+		if (aggstate->hash_input_file)
+			outerslot = hash_agg_read_spilled_tuple(aggstate, &hashvalue);
+		else
+			outerslot = fetch_input_tuple(aggstate);
 		if (TupIsNull(outerslot))
 			break;
 		/* set up for advance_aggregates call */
 		tmpcontext->ecxt_outertuple = outerslot;
 
-		/* Find or build hashtable entry for this tuple's group */
-		entry = lookup_hash_entry(aggstate, outerslot);
+		/*
+		 * Find or build the hashtable entry of this tuple's group in each
+		 * grouping set we're filling.
+		 */
+		for (setno = 0; setno < aggstate->numhashes; setno++)
+		{
+			AggHashEntry entry;
+
+			pergroups[setno] = NULL;
+			if (aggstate->hash_pass_set >= 0 && aggstate->hash_pass_set != setno)
+				continue;
+
+			entry = lookup_hash_entry(aggstate, setno, outerslot);
+			if (entry != NULL)
+				pergroups[setno] = entry->pergroup;
+			else
+			{
+				/* No room for its group, so leave the tuple for a later pass */
+				if (!aggstate->hash_input_file)
+					hashvalue = hash_agg_hash_tuple(aggstate, setno, outerslot);
+				hash_agg_spill_tuple(aggstate, setno, outerslot, hashvalue);
+			}
+		}
 
 		/* Advance the aggregates */
-		advance_aggregates(aggstate, entry->pergroup);
+		advance_aggregates(aggstate, NULL, pergroups);
 
 		/* Reset per-input-tuple context after each tuple */
 		ResetExprContext(tmpcontext);
 	}
 
+	/* Count the first pass once, and each spilled partition read back */
+	if (aggstate->hash_batches_used == 0 || aggstate->hash_input_file)
+		aggstate->hash_batches_used++;
+	hash_agg_finish_pass(aggstate);
+
 	aggstate->table_filled = true;
-	/* Initialize to walk the hash table */
-	ResetTupleHashIterator(aggstate->hashtable, &aggstate->hashiter);
+	/* Initialize to walk the hash table, or the first one of several */
+	hash_agg_begin_iteration(aggstate, Max(aggstate->hash_pass_set, 0));
 }
 
 /*
- * ExecAgg for hashed case: phase 2, retrieving groups from hash table
+ * ExecAgg for hashed case: phase 2, retrieving groups from hash tables
  */
 static TupleTableSlot *
 agg_retrieve_hash_table(AggState *aggstate)
@@ -1872,6 +2404,7 @@ agg_retrieve_hash_table(AggState *aggstate)
 	AggHashEntry entry;
 	TupleTableSlot *firstSlot;
 	TupleTableSlot *result;
+	int			setno;
 
 	/*
 	 * get state info from node
@@ -1887,12 +2420,32 @@ agg_retrieve_hash_table(AggState *aggstate)
 	 */
 	while (!aggstate->agg_done)
 	{
+		setno = aggstate->hash_iter_set;
+
 		/*
 		 * Find the next entry in the hash table
 		 */
-		entry = (AggHashEntry) ScanTupleHashTable(&aggstate->hashiter);
+		entry = (AggHashEntry) ScanTupleHashTable(aggstate->perhash[setno].hashtable,
+									&aggstate->perhash[setno].hashiter);
 		if (entry == NULL)
 		{
+			/*
+			 * After the first pass, move on to the next grouping set's table;
+			 * after a spilled partition, only its set's table was filled.
+			 */
+			if (aggstate->hash_pass_set < 0 && setno + 1 < aggstate->numhashes)
+			{
+				hash_agg_begin_iteration(aggstate, setno + 1);
+				continue;
+			}
+
+			/* Move on to the next spilled partition, if there is one */
+			if (aggstate->hash_pending != NIL)
+			{
+				hash_agg_next_partition(aggstate);
+				continue;
+			}
+
 			/* No more entries in hashtable, so done */
 			aggstate->agg_done = TRUE;
 			return NULL;
@@ -1914,10 +2467,11 @@ agg_retrieve_hash_table(AggState *aggstate)
 		ExecStoreMinimalTuple(entry->shared.firstTuple,
 							  firstSlot,
 							  false);
+		prepare_projection_slot(aggstate, firstSlot, setno);
 
 		pergroup = entry->pergroup;
 
-		finalize_aggregates(aggstate, peragg, pergroup, 0);
+		finalize_aggregates(aggstate, peragg, pergroup, setno);
 
 		/*
 		 * Use the representative input tuple for any references to
@@ -1972,7 +2526,6 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 	aggstate->aggs = NIL;
 	aggstate->numaggs = 0;
 	aggstate->maxsets = 0;
-	aggstate->hashfunctions = NULL;
 	aggstate->projected_set = -1;
 	aggstate->current_set = 0;
 	aggstate->peragg = NULL;
@@ -1981,31 +2534,48 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 	aggstate->input_done = false;
 	aggstate->pergroup = NULL;
 	aggstate->grp_firstTuple = NULL;
-	aggstate->hashtable = NULL;
+	aggstate->perhash = NULL;
+	aggstate->numhashes = 0;
+	aggstate->hash_pergroups = NULL;
+	aggstate->hash_iter_set = 0;
+	aggstate->hash_mem_limit = work_mem * 1024L;
+	aggstate->hash_spill_mode = false;
+	aggstate->hash_pass_set = -1;
+	aggstate->hash_spill_level = 0;
+	aggstate->hash_pending = NIL;
+	aggstate->hash_input_file = NULL;
+	aggstate->hash_spilled = false;
+	aggstate->hash_batches_used = 0;
+	aggstate->hash_mem_peak = 0;
 	aggstate->sort_in = NULL;
 	aggstate->sort_out = NULL;
 
 	/*
 	 * Calculate the maximum number of grouping sets in any phase; this
-	 * determines the size of some allocations.
+	 * determines the size of some allocations.  In hashed mode, all the
+	 * grouping sets are computed in a single phase, one per Agg node.
 	 */
 	if (node->groupingSets)
 	{
-		Assert(node->aggstrategy != AGG_HASHED);
-
 		numGroupingSets = list_length(node->groupingSets);
 
 		foreach(l, node->chain)
 		{
 			Agg		   *agg = lfirst(l);
 
-			numGroupingSets = Max(numGroupingSets,
-								  list_length(agg->groupingSets));
+			if (node->aggstrategy == AGG_HASHED)
+				numGroupingSets += list_length(agg->groupingSets);
+			else
+				numGroupingSets = Max(numGroupingSets,
+									  list_length(agg->groupingSets));
 		}
 	}
 
 	aggstate->maxsets = numGroupingSets;
-	aggstate->numphases = numPhases = 1 + list_length(node->chain);
+	if (node->aggstrategy == AGG_HASHED)
+		aggstate->numphases = numPhases = 1;
+	else
+		aggstate->numphases = numPhases = 1 + list_length(node->chain);
 
 	aggstate->aggcontexts = (ExprContext **)
 		palloc0(sizeof(ExprContext *) * numGroupingSets);
@@ -2039,7 +2609,7 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 	 */
 	ExecInitScanTupleSlot(estate, &aggstate->ss);
 	ExecInitResultTupleSlot(estate, &aggstate->ss.ps);
-	aggstate->hashslot = ExecInitExtraTupleSlot(estate);
+	aggstate->hash_spill_slot = ExecInitExtraTupleSlot(estate);
 	aggstate->sort_slot = ExecInitExtraTupleSlot(estate);
 
 	/*
@@ -2130,7 +2700,36 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 
 		phasedata->numsets = num_sets = list_length(aggnode->groupingSets);
 
-		if (num_sets)
+		if (num_sets && aggnode->aggstrategy == AGG_HASHED)
+		{
+			/*
+			 * The grouping sets of a hashed aggregation are those of the Agg
+			 * node and of each node in its chain, each with its own grouping
+			 * columns.
+			 */
+			List	   *setnodes = lcons(aggnode, list_copy(aggnode->chain));
+
+			phasedata->numsets = num_sets = list_length(setnodes);
+			phasedata->gset_lengths = palloc(num_sets * sizeof(int));
+			phasedata->grouped_cols = palloc(num_sets * sizeof(Bitmapset *));
+
+			i = 0;
+			foreach(l, setnodes)
+			{
+				Agg		   *setnode = lfirst(l);
+				Bitmapset  *cols = NULL;
+
+				for (j = 0; j < setnode->numCols; ++j)
+					cols = bms_add_member(cols, setnode->grpColIdx[j]);
+
+				phasedata->grouped_cols[i] = cols;
+				phasedata->gset_lengths[i] = setnode->numCols;
+				all_grouped_cols = bms_add_members(all_grouped_cols, cols);
+				++i;
+			}
+			list_free(setnodes);
+		}
+		else if (num_sets)
 		{
 			phasedata->gset_lengths = palloc(num_sets * sizeof(int));
 			phasedata->grouped_cols = palloc(num_sets * sizeof(Bitmapset *));
@@ -2185,14 +2784,36 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 		aggstate->all_grouped_cols = lcons_int(i, aggstate->all_grouped_cols);
 
 	/*
-	 * Hashing can only appear in the initial phase.
+	 * Hashing can only appear in the initial phase.  Set up the per-hashtable
+	 * data for each grouping set; the hashslots are given the input's tuple
+	 * type, with all unused columns NULL.
 	 */
-
 	if (node->aggstrategy == AGG_HASHED)
-		execTuplesHashPrepare(node->numCols,
-							  node->grpOperators,
-							  &aggstate->phases[0].eqfunctions,
-							  &aggstate->hashfunctions);
+	{
+		int			setno;
+
+		aggstate->numhashes = numGroupingSets;
+		aggstate->perhash = (AggStatePerHash)
+			palloc0(numGroupingSets * sizeof(AggStatePerHashData));
+		aggstate->hash_pergroups = (AggStatePerGroup *)
+			palloc0(numGroupingSets * sizeof(AggStatePerGroup));
+
+		for (setno = 0; setno < numGroupingSets; setno++)
+		{
+			AggStatePerHash perhash = &aggstate->perhash[setno];
+
+			perhash->aggnode = (setno == 0) ? node :
+				(Agg *) list_nth(node->chain, setno - 1);
+			execTuplesHashPrepare(perhash->aggnode->numCols,
+								  perhash->aggnode->grpOperators,
+								  &perhash->eqfunctions,
+								  &perhash->hashfunctions);
+			perhash->hashslot = ExecInitExtraTupleSlot(estate);
+			ExecSetSlotDescriptor(perhash->hashslot,
+								  ExecGetResultType(outerPlanState(aggstate)));
+			ExecStoreAllNullTuple(perhash->hashslot);
+		}
+	}
 
 	/*
 	 * Initialize current phase-dependent values to initial phase
@@ -2214,10 +2835,19 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 
 	if (node->aggstrategy == AGG_HASHED)
 	{
-		build_hash_table(aggstate);
+		int			setno;
+
+		for (setno = 0; setno < aggstate->numhashes; setno++)
+		{
+			build_hash_table(aggstate, setno);
+			/* Compute the columns we actually need to hash on */
+			aggstate->perhash[setno].hash_needed =
+				find_hash_columns(aggstate, setno);
+		}
 		aggstate->table_filled = false;
-		/* Compute the columns we actually need to hash on */
-		aggstate->hash_needed = find_hash_columns(aggstate);
+		/* Spilled tuples are read back in the format of the input */
+		ExecSetSlotDescriptor(aggstate->hash_spill_slot,
+							  ExecGetResultType(outerPlanState(aggstate)));
 	}
 	else
 	{
@@ -2311,8 +2941,30 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 						   get_func_name(aggref->aggfnoid));
 		InvokeFunctionExecuteHook(aggref->aggfnoid);
 
-		peraggstate->transfn_oid = transfn_oid = aggform->aggtransfn;
-		peraggstate->finalfn_oid = finalfn_oid = aggform->aggfinalfn;
+		/*
+		 * When combining partial states produced by another Agg node, the
+		 * combine function takes the place of the transition function.  The
+		 * Aggref we see here then has a single argument, of the transition
+		 * type, so the code below works unchanged.
+		 */
+		if (node->combineStates)
+		{
+			transfn_oid = aggform->aggcombinefn;
+
+			if (!OidIsValid(transfn_oid))
+				elog(ERROR, "combinefn not set for aggregate function %u",
+					 aggref->aggfnoid);
+		}
+		else
+			transfn_oid = aggform->aggtransfn;
+		peraggstate->transfn_oid = transfn_oid;
+
+		/* Final function only runs if the consumer wants finished values */
+		if (node->finalizeAggs)
+			finalfn_oid = aggform->aggfinalfn;
+		else
+			finalfn_oid = InvalidOid;
+		peraggstate->finalfn_oid = finalfn_oid;
 
 		/* Check that aggregate owner has permission to call component fns */
 		{
@@ -2626,6 +3278,9 @@ ExecEndAgg(AggState *node)
 	for (setno = 0; setno < numGroupingSets; setno++)
 		ReScanExprContext(node->aggcontexts[setno]);
 
+	/* Close any temporary files of a spilled hash aggregation */
+	hash_agg_reset_spill_state(node);
+
 	/*
 	 * We don't actually free any ExprContexts here (see comment in
 	 * ExecFreeExprContext), just unlinking the output one from the plan node
@@ -2668,11 +3323,12 @@ ExecReScanAgg(AggState *node)
 		/*
 		 * If we do have the hash table and the subplan does not have any
 		 * parameter changes, then we can just rescan the existing hash table;
-		 * no need to build it again.
+		 * no need to build it again.  That doesn't work if we spilled,
+		 * though, since then the table holds only the last partition.
 		 */
-		if (outerPlan->chgParam == NULL)
+		if (outerPlan->chgParam == NULL && !node->hash_spilled)
 		{
-			ResetTupleHashIterator(node->hashtable, &node->hashiter);
+			hash_agg_begin_iteration(node, 0);
 			return;
 		}
 	}
@@ -2723,8 +3379,10 @@ ExecReScanAgg(AggState *node)
 
 	if (aggnode->aggstrategy == AGG_HASHED)
 	{
-		/* Rebuild an empty hash table */
-		build_hash_table(node);
+		/* Discard any spilled partitions, and rebuild empty hash tables */
+		hash_agg_reset_spill_state(node);
+		for (setno = 0; setno < node->numhashes; setno++)
+			build_hash_table(node, setno);
 		node->table_filled = false;
 	}
 	else
@@ -53,14 +53,43 @@
  *			  nil	nil		 Scan	 Scan	  Scan	   Scan
  *							  |		  |		   |		|
  *							person employee student student-emp
+ *
+ *		Foreign scans whose FDW supports it are run asynchronously, so
+ *		that for example scans of several remote servers proceed at the
+ *		same time.  Their tuples are returned as they become available,
+ *		interleaved with those of the other subplans, which are still run
+ *		one after another.
  */
 
 #include "postgres.h"
 
+#include <unistd.h>
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+#ifdef HAVE_SYS_POLL_H
+#include <sys/poll.h>
+#endif
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
+
 #include "executor/execdebug.h"
 #include "executor/nodeAppend.h"
+#include "executor/nodeForeignscan.h"
+#include "miscadmin.h"
+
+/*
+ * While running the synchronous subplans, check whether the asynchronous
+ * ones have received something every this many tuples.
+ */
+#define ASYNC_POLL_INTERVAL		100
 
 static bool exec_append_initialize_next(AppendState *appendstate);
+static void exec_append_start_async(AppendState *node);
+static TupleTableSlot *exec_append_async(AppendState *node);
+static TupleTableSlot *exec_append_async_next(AppendState *node);
+static bool exec_append_async_wait(AppendState *node, bool block);
 
 
 /* ----------------------------------------------------------------
@@ -108,7 +137,8 @@ exec_append_initialize_next(AppendState *appendstate)
 /* ----------------------------------------------------------------
  *		ExecInitAppend
  *
- *		Begin all of the subscans of the append node.
+ *		Begin all of the subscans of the append node, except those that
+ *		ExecPruneSubplans finds can't return any rows.
  *
  *	   (This is potentially wasteful, since the entire result of the
  *		append node may not be scanned, but this way all of the
@@ -122,16 +152,24 @@ ExecInitAppend(Append *node, EState *estate, int eflags)
 	AppendState *appendstate = makeNode(AppendState);
 	PlanState **appendplanstates;
 	int			nplans;
+	List	   *subplans;
 	int			i;
 	ListCell   *lc;
 
 	/* check for unsupported flags */
 	Assert(!(eflags & EXEC_FLAG_MARK));
 
+	/*
+	 * Leave out the subplans that can't return any rows given the values of
+	 * the query's Params, if the planner told us how to find them.
+	 */
+	subplans = ExecPruneSubplans(estate, node->appendplans,
+								 node->prunequals, node->pruneconstrs);
+
 	/*
 	 * Set up empty vector of subplan states
 	 */
-	nplans = list_length(node->appendplans);
+	nplans = list_length(subplans);
 
 	appendplanstates = (PlanState **) palloc0(nplans * sizeof(PlanState *));
 
@@ -161,7 +199,7 @@ ExecInitAppend(Append *node, EState *estate, int eflags)
 	 * results into the array "appendplans".
 	 */
 	i = 0;
-	foreach(lc, node->appendplans)
+	foreach(lc, subplans)
 	{
 		Plan	   *initNode = (Plan *) lfirst(lc);
 
@@ -169,6 +207,32 @@ ExecInitAppend(Append *node, EState *estate, int eflags)
 		i++;
 	}
 
+	/*
+	 * Run the foreign scans asynchronously, if their FDWs support it.  Not
+	 * when we might have to scan backwards, though.
+	 */
+	if (!(eflags & (EXEC_FLAG_BACKWARD | EXEC_FLAG_EXPLAIN_ONLY)))
+	{
+		for (i = 0; i < nplans; i++)
+		{
+			PlanState  *subnode = appendplanstates[i];
+
+			if (!IsA(subnode, ForeignScanState) ||
+				!ExecForeignScanAsyncCapable((ForeignScanState *) subnode))
+				continue;
+
+			if (appendstate->as_async == NULL)
+			{
+				appendstate->as_async = (bool *) palloc0(nplans * sizeof(bool));
+				appendstate->as_asyncdone = (bool *) palloc(nplans * sizeof(bool));
+				appendstate->as_waitsocks = (pgsocket *)
+					palloc(nplans * sizeof(pgsocket));
+			}
+			appendstate->as_async[i] = true;
+			appendstate->as_nasync++;
+		}
+	}
+
 	/*
 	 * initialize output tuple type
 	 */
@@ -180,6 +244,7 @@ ExecInitAppend(Append *node, EState *estate, int eflags)
 	 */
 	appendstate->as_whichplan = 0;
 	exec_append_initialize_next(appendstate);
+	exec_append_start_async(appendstate);
 
 	return appendstate;
 }
@@ -193,6 +258,9 @@ ExecInitAppend(Append *node, EState *estate, int eflags)
 TupleTableSlot *
 ExecAppend(AppendState *node)
 {
+	if (node->as_nasync > 0)
+		return exec_append_async(node);
+
 	for (;;)
 	{
 		PlanState  *subnode;
@@ -280,11 +348,252 @@ ExecReScanAppend(AppendState *node)
 
 		/*
 		 * If chgParam of subnode is not null then plan will be re-scanned by
-		 * first ExecProcNode.
+		 * first ExecProcNode.  Asynchronous subplans are asked to start
+		 * fetching before that, so rescan them right away.
 		 */
-		if (subnode->chgParam == NULL)
+		if (subnode->chgParam == NULL ||
+			(node->as_async != NULL && node->as_async[i]))
 			ExecReScan(subnode);
 	}
 	node->as_whichplan = 0;
 	exec_append_initialize_next(node);
+	exec_append_start_async(node);
+}
+
+/* ----------------------------------------------------------------
+ *		exec_append_start_async
+ *
+ *		Sets up the state of the asynchronous subplans for a new scan.
+ * ----------------------------------------------------------------
+ */
+static void
+exec_append_start_async(AppendState *node)
+{
+	int			i;
+
+	if (node->as_nasync == 0)
+		return;
+
+	for (i = 0; i < node->as_nplans; i++)
+	{
+		node->as_asyncdone[i] = false;
+		node->as_waitsocks[i] = PGINVALID_SOCKET;
+	}
+	node->as_nasyncremaining = node->as_nasync;
+	node->as_nextasync = 0;
+	node->as_syncsincepoll = 0;
+}
+
+/* ----------------------------------------------------------------
+ *		exec_append_async
+ *
+ *		ExecAppend for an append node with asynchronous subplans.
+ *		Tuples are returned from whichever asynchronous subplan has some
+ *		ready.  While none has, the synchronous subplans are run one after
+ *		another, and once they are done we wait for an asynchronous one.
+ * ----------------------------------------------------------------
+ */
+static TupleTableSlot *
+exec_append_async(AppendState *node)
+{
+	for (;;)
+	{
+		TupleTableSlot *result;
+
+		result = exec_append_async_next(node);
+		if (result != NULL)
+			return result;
+
+		/* skip over the asynchronous subplans */
+		while (node->as_whichplan < node->as_nplans &&
+			   node->as_async[node->as_whichplan])
+			node->as_whichplan++;
+
+		if (node->as_whichplan < node->as_nplans)
+		{
+			/*
+			 * Every so often, check without blocking whether any of the
+			 * asynchronous subplans has received something.
+			 */
+			if (node->as_syncsincepoll >= ASYNC_POLL_INTERVAL)
+			{
+				node->as_syncsincepoll = 0;
+				if (exec_append_async_wait(node, false))
+					continue;
+			}
+
+			result = ExecProcNode(node->appendplans[node->as_whichplan]);
+			if (!TupIsNull(result))
+			{
+				node->as_syncsincepoll++;
+				return result;
+			}
+			node->as_whichplan++;
+			continue;
+		}
+
+		if (node->as_nasyncremaining == 0)
+			return ExecClearTuple(node->ps.ps_ResultTupleSlot);
+
+		/* Nothing else to do but wait for an asynchronous subplan */
+		exec_append_async_wait(node, true);
+	}
+}
+
+/* ----------------------------------------------------------------
+ *		exec_append_async_next
+ *
+ *		Returns a tuple from an asynchronous subplan that has one ready,
+ *		or NULL if none has.  The subplan that returned the last tuple is
+ *		asked first, then the others in turn; asking one that has no tuples
+ *		ready makes it start fetching more.  Subplans waiting on a socket
+ *		that hasn't become readable yet are skipped.
+ * ----------------------------------------------------------------
+ */
+static TupleTableSlot *
+exec_append_async_next(AppendState *node)
+{
+	int			n;
+
+	for (n = 0; n < node->as_nplans; n++)
+	{
+		int			i = (node->as_nextasync + n) % node->as_nplans;
+		ForeignScanState *subnode;
+		TupleTableSlot *result;
+
+		if (!node->as_async[i] || node->as_asyncdone[i] ||
+			node->as_waitsocks[i] != PGINVALID_SOCKET)
+			continue;
+
+		subnode = (ForeignScanState *) node->appendplans[i];
+		if (!ExecForeignScanAsyncReady(subnode, &node->as_waitsocks[i]))
+		{
+			if (node->as_waitsocks[i] == PGINVALID_SOCKET)
+				elog(ERROR, "asynchronous foreign scan has no socket to wait on");
+			continue;
+		}
+
+		result = ExecProcNode((PlanState *) subnode);
+		if (!TupIsNull(result))
+		{
+			node->as_nextasync = i;
+			return result;
+		}
+
+		node->as_asyncdone[i] = true;
+		node->as_nasyncremaining--;
+	}
+
+	return NULL;
+}
+
+/* ----------------------------------------------------------------
+ *		exec_append_async_wait
+ *
+ *		Waits until the socket of an asynchronous subplan becomes readable,
+ *		or if 'block' is false, just checks for that.  The subplans whose
+ *		sockets are readable are marked as no longer waiting, so that they
+ *		are asked again.  Returns true if there were any.
+ * ----------------------------------------------------------------
+ */
+static bool
+exec_append_async_wait(AppendState *node, bool block)
+{
+	int		   *plans;
+	int			nsocks = 0;
+	bool		found = false;
+	int			rc;
+	int			i;
+#ifdef HAVE_POLL
+	struct pollfd *pfds;
+#else
+	fd_set		input_mask;
+	pgsocket	maxsock = 0;
+	struct timeval tv;
+#endif
+
+	plans = (int *) palloc(node->as_nplans * sizeof(int));
+#ifdef HAVE_POLL
+	pfds = (struct pollfd *) palloc(node->as_nplans * sizeof(struct pollfd));
+#else
+	FD_ZERO(&input_mask);
+#endif
+
+	for (i = 0; i < node->as_nplans; i++)
+	{
+		if (node->as_waitsocks[i] == PGINVALID_SOCKET)
+			continue;
+#ifdef HAVE_POLL
+		pfds[nsocks].fd = node->as_waitsocks[i];
+		pfds[nsocks].events = POLLIN;
+		pfds[nsocks].revents = 0;
+#else
+		FD_SET(node->as_waitsocks[i], &input_mask);
+		if (node->as_waitsocks[i] > maxsock)
+			maxsock = node->as_waitsocks[i];
+#endif
+		plans[nsocks++] = i;
+	}
+
+	if (nsocks == 0)
+	{
+		pfree(plans);
+#ifdef HAVE_POLL
+		pfree(pfds);
+#endif
+		return false;
+	}
+
+	/*
+	 * Wake up every second to check for interrupts, in case the signal
+	 * arrived just before we started waiting.
+	 */
+	for (;;)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+#ifdef HAVE_POLL
+		rc = poll(pfds, nsocks, block ? 1000 : 0);
+#else
+		tv.tv_sec = block ? 1 : 0;
+		tv.tv_usec = 0;
+		rc = select(maxsock + 1, &input_mask, NULL, NULL, &tv);
+#endif
+		if (rc < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			ereport(ERROR,
+					(errcode_for_socket_access(),
+					 errmsg("could not wait for foreign scans: %m")));
+		}
+		if (rc > 0 || !block)
+			break;
+
+#ifndef HAVE_POLL
+		/* select() cleared the mask on timeout, so set it up again */
+		for (i = 0; i < nsocks; i++)
+			FD_SET(node->as_waitsocks[plans[i]], &input_mask);
+#endif
+	}
+
+	for (i = 0; rc > 0 && i < nsocks; i++)
+	{
+#ifdef HAVE_POLL
+		if (pfds[i].revents == 0)
+			continue;
+#else
+		if (!FD_ISSET(node->as_waitsocks[plans[i]], &input_mask))
+			continue;
+#endif
+		node->as_waitsocks[plans[i]] = PGINVALID_SOCKET;
+		found = true;
+	}
+
+	pfree(plans);
+#ifdef HAVE_POLL
+	pfree(pfds);
+#endif
+
+	return found;
 }
@@ -15,6 +15,13 @@
  * but with anything else we might return a tuple that doesn't meet the
  * required index qual conditions.
  *
+ * A parallel-aware bitmap heap scan builds its bitmap only once: the first
+ * participant to get to it runs the child plan, and copies the result into
+ * the parallel query's dynamic shared memory segment, from where all the
+ * participants then take pages to scan (see tidbitmap.c).  The others just
+ * wait for the bitmap meanwhile, as there is no way to divide the work of
+ * the index scans between them.
+ *
  *
  * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
  * Portions Copyright (c) 1994, Regents of the University of California
@@ -32,6 +39,9 @@
  *		ExecInitBitmapHeapScan		creates and initializes state info.
  *		ExecReScanBitmapHeapScan	prepares to rescan the plan.
  *		ExecEndBitmapHeapScan		releases all storage.
+ *		ExecBitmapHeapEstimate		estimates DSM space needed for parallel scan
+ *		ExecBitmapHeapInitializeDSM initialize DSM for parallel scan
+ *		ExecBitmapHeapInitializeWorker attach to DSM info in parallel worker
  */
 #include "postgres.h"
 
@@ -39,17 +49,50 @@
 #include "access/transam.h"
 #include "executor/execdebug.h"
 #include "executor/nodeBitmapHeapscan.h"
+#include "miscadmin.h"
 #include "pgstat.h"
 #include "storage/bufmgr.h"
 #include "storage/predicate.h"
+#include "storage/proc.h"
+#include "storage/spin.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
 #include "utils/snapmgr.h"
 #include "utils/tqual.h"
 
 
+/*
+ * Shared state of a parallel bitmap heap scan.  It is followed by the
+ * TBMSharedIteratorState the bitmap is copied into, at iterstate_offset.
+ * The spinlock protects all fields except the waiters[] array, which can
+ * only change while state is PBH_INITIAL or PBH_INPROGRESS.
+ */
+typedef enum
+{
+	PBH_INITIAL,				/* nobody has started building the bitmap */
+	PBH_INPROGRESS,				/* somebody is building it */
+	PBH_FINISHED				/* it's built, go ahead and scan */
+} PBHState;
+
+typedef struct ParallelBitmapHeapStateData
+{
+	slock_t		mutex;
+	PBHState	state;
+	bool		overflow;		/* bitmap didn't fit, builder scans alone */
+	int			nwaiters;		/* number of valid entries in waiters[] */
+	int			maxwaiters;		/* allocated length of waiters[] */
+	Size		iterstate_offset;	/* offset of TBMSharedIteratorState */
+	int			waiters[FLEXIBLE_ARRAY_MEMBER]; /* pgprocnos of waiters */
+} ParallelBitmapHeapStateData;
+
+#define ParallelBitmapHeapIterState(pstate) \
+	((TBMSharedIteratorState *) ((char *) (pstate) + (pstate)->iterstate_offset))
+
 static TupleTableSlot *BitmapHeapNext(BitmapHeapScanState *node);
+static void BitmapHeapBuildShared(BitmapHeapScanState *node);
 static void bitgetpage(HeapScanDesc scan, TBMIterateResult *tbmres);
+static Size ExecBitmapHeapLayout(BitmapHeapScanState *node, int nparticipants,
+					 ParallelBitmapHeapState pstate);
 
 
 /* ----------------------------------------------------------------
@@ -98,8 +141,18 @@ BitmapHeapNext(BitmapHeapScanState *node)
 	 * GUC-controlled maximum, target_prefetch_pages.  This is to avoid doing
 	 * a lot of prefetching in a scan that stops after a few tuples because of
 	 * a LIMIT.
+	 *
+	 * A parallel scan doesn't prefetch, since the pages we'd get from a second
+	 * shared iterator would be mostly the ones the other participants are
+	 * about to read.
 	 */
-	if (tbm == NULL)
+	if (!node->initialized && node->pstate != NULL)
+	{
+		BitmapHeapBuildShared(node);
+		tbmiterator = node->tbmiterator;
+		node->initialized = true;
+	}
+	else if (!node->initialized)
 	{
 		tbm = (TIDBitmap *) MultiExecProcNode(outerPlanState(node));
 
@@ -118,6 +171,7 @@ BitmapHeapNext(BitmapHeapScanState *node)
 			node->prefetch_target = -1;
 		}
 #endif   /* USE_PREFETCH */
+		node->initialized = true;
 	}
 
 	for (;;)
@@ -130,7 +184,11 @@ BitmapHeapNext(BitmapHeapScanState *node)
 		 */
 		if (tbmres == NULL)
 		{
-			node->tbmres = tbmres = tbm_iterate(tbmiterator);
+			if (node->shared_iterator)
+				tbmres = tbm_shared_iterate(node->shared_iterator);
+			else if (tbmiterator)
+				tbmres = tbm_iterate(tbmiterator);
+			node->tbmres = tbmres;
 			if (tbmres == NULL)
 			{
 				/* no more entries in the bitmap */
@@ -305,6 +363,94 @@ BitmapHeapNext(BitmapHeapScanState *node)
 	return ExecClearTuple(slot);
 }
 
+/*
+ * BitmapHeapBuildShared - subroutine for BitmapHeapNext()
+ *
+ * Begin a parallel scan: if we're first, build the bitmap and copy it into
+ * shared memory, else wait for whoever is doing that.  Then set up to take
+ * pages from it along with the other participants.  If the bitmap didn't
+ * fit, the builder scans its own copy all by itself, and the others have
+ * nothing to do.
+ */
+static void
+BitmapHeapBuildShared(BitmapHeapScanState *node)
+{
+	ParallelBitmapHeapState pstate = node->pstate;
+	TBMSharedIteratorState *iterstate = ParallelBitmapHeapIterState(pstate);
+	bool		build;
+	bool		overflow;
+	bool		registered = false;
+	int			i;
+
+	SpinLockAcquire(&pstate->mutex);
+	build = (pstate->state == PBH_INITIAL);
+	if (build)
+		pstate->state = PBH_INPROGRESS;
+	SpinLockRelease(&pstate->mutex);
+
+	if (build)
+	{
+		TIDBitmap  *tbm;
+
+		tbm = (TIDBitmap *) MultiExecProcNode(outerPlanState(node));
+
+		if (!tbm || !IsA(tbm, TIDBitmap))
+			elog(ERROR, "unrecognized result from subplan");
+
+		overflow = !tbm_shared_fill(tbm, iterstate);
+		if (overflow)
+		{
+			node->tbm = tbm;
+			node->tbmiterator = tbm_begin_iterate(tbm);
+		}
+		else
+			tbm_free(tbm);
+
+		SpinLockAcquire(&pstate->mutex);
+		pstate->state = PBH_FINISHED;
+		pstate->overflow = overflow;
+		SpinLockRelease(&pstate->mutex);
+
+		/*
+		 * Wake up the others.  The waiters[] array can't change any more,
+		 * since nobody registers once the bitmap is finished.
+		 */
+		for (i = 0; i < pstate->nwaiters; i++)
+			SetLatch(&ProcGlobal->allProcs[pstate->waiters[i]].procLatch);
+	}
+	else
+	{
+		/* Wait for the bitmap to be finished */
+		for (;;)
+		{
+			bool		done;
+
+			SpinLockAcquire(&pstate->mutex);
+			done = (pstate->state == PBH_FINISHED);
+			overflow = pstate->overflow;
+			if (!done && !registered)
+			{
+				Assert(pstate->nwaiters < pstate->maxwaiters);
+				pstate->waiters[pstate->nwaiters++] = MyProc->pgprocno;
+				registered = true;
+			}
+			SpinLockRelease(&pstate->mutex);
+
+			if (done)
+				break;
+
+			pgstat_report_wait_start(WAIT_EVENT_BITMAP_BUILD);
+			WaitLatch(MyLatch, WL_LATCH_SET, 0);
+			pgstat_report_wait_end();
+			ResetLatch(MyLatch);
+			CHECK_FOR_INTERRUPTS();
+		}
+	}
+
+	if (!overflow)
+		node->shared_iterator = tbm_attach_shared_iterate(iterstate);
+}
+
 /*
  * bitgetpage - subroutine for BitmapHeapNext()
  *
@@ -458,12 +604,23 @@ ExecReScanBitmapHeapScan(BitmapHeapScanState *node)
 		tbm_end_iterate(node->tbmiterator);
 	if (node->prefetch_iterator)
 		tbm_end_iterate(node->prefetch_iterator);
+	if (node->shared_iterator)
+		tbm_end_shared_iterate(node->shared_iterator);
 	if (node->tbm)
 		tbm_free(node->tbm);
+	node->initialized = false;
 	node->tbm = NULL;
 	node->tbmiterator = NULL;
 	node->tbmres = NULL;
 	node->prefetch_iterator = NULL;
+	node->shared_iterator = NULL;
+
+	/*
+	 * The shared state of a parallel scan belongs to the Gather node above
+	 * us, which tears it down before rescanning us and sets it up afresh
+	 * before running us again, if it still runs in parallel.
+	 */
+	node->pstate = NULL;
 
 	ExecScanReScan(&node->ss);
 
@@ -514,6 +671,8 @@ ExecEndBitmapHeapScan(BitmapHeapScanState *node)
 		tbm_end_iterate(node->tbmiterator);
 	if (node->prefetch_iterator)
 		tbm_end_iterate(node->prefetch_iterator);
+	if (node->shared_iterator)
+		tbm_end_shared_iterate(node->shared_iterator);
 	if (node->tbm)
 		tbm_free(node->tbm);
 
@@ -556,6 +715,7 @@ ExecInitBitmapHeapScan(BitmapHeapScan *node, EState *estate, int eflags)
 	scanstate->ss.ps.plan = (Plan *) node;
 	scanstate->ss.ps.state = estate;
 
+	scanstate->initialized = false;
 	scanstate->tbm = NULL;
 	scanstate->tbmiterator = NULL;
 	scanstate->tbmres = NULL;
@@ -564,6 +724,8 @@ ExecInitBitmapHeapScan(BitmapHeapScan *node, EState *estate, int eflags)
 	scanstate->prefetch_iterator = NULL;
 	scanstate->prefetch_pages = 0;
 	scanstate->prefetch_target = 0;
+	scanstate->pstate = NULL;
+	scanstate->shared_iterator = NULL;
 
 	/*
 	 * Miscellaneous initialization
@@ -634,3 +796,101 @@ ExecInitBitmapHeapScan(BitmapHeapScan *node, EState *estate, int eflags)
 	 */
 	return scanstate;
 }
+
+/* ----------------------------------------------------------------
+ *						Parallel Scan Support
+ * ----------------------------------------------------------------
+ */
+
+/*
+ * ExecBitmapHeapLayout
+ *		compute the size of the shared state for nparticipants processes
+ *
+ * The space for the bitmap is estimated from the number of rows the child
+ * plan is expected to return, up to the work_mem limit it is built with.
+ * If 'pstate' isn't NULL, also fill in its layout fields.
+ */
+static Size
+ExecBitmapHeapLayout(BitmapHeapScanState *node, int nparticipants,
+					 ParallelBitmapHeapState pstate)
+{
+	Plan	   *bitmapplan = outerPlan(node->ss.ps.plan);
+	Size		iterstate_offset;
+	Size		iterstate_size;
+
+	iterstate_offset = MAXALIGN(add_size(offsetof(ParallelBitmapHeapStateData,
+												  waiters),
+										 mul_size(nparticipants,
+												  sizeof(int))));
+	iterstate_size = tbm_shared_estimate(bitmapplan->plan_rows,
+										 work_mem * 1024L);
+
+	if (pstate != NULL)
+	{
+		pstate->maxwaiters = nparticipants;
+		pstate->iterstate_offset = iterstate_offset;
+		tbm_shared_init(ParallelBitmapHeapIterState(pstate), iterstate_size);
+	}
+
+	return add_size(iterstate_offset, iterstate_size);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecBitmapHeapEstimate
+ *
+ *		estimates the space required for the shared state and bitmap.
+ * ----------------------------------------------------------------
+ */
+void
+ExecBitmapHeapEstimate(BitmapHeapScanState *node, ParallelContext *pcxt)
+{
+	shm_toc_estimate_chunk(&pcxt->estimator,
+						   ExecBitmapHeapLayout(node, pcxt->nworkers + 1,
+												NULL));
+	shm_toc_estimate_keys(&pcxt->estimator, 1);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecBitmapHeapInitializeDSM
+ *
+ *		Set up the shared state, with no bitmap yet.
+ * ----------------------------------------------------------------
+ */
+void
+ExecBitmapHeapInitializeDSM(BitmapHeapScanState *node, ParallelContext *pcxt)
+{
+	ParallelBitmapHeapState pstate;
+	Size		size;
+
+	size = ExecBitmapHeapLayout(node, pcxt->nworkers + 1, NULL);
+	pstate = shm_toc_allocate(pcxt->toc, size);
+
+	SpinLockInit(&pstate->mutex);
+	pstate->state = PBH_INITIAL;
+	pstate->overflow = false;
+	pstate->nwaiters = 0;
+	(void) ExecBitmapHeapLayout(node, pcxt->nworkers + 1, pstate);
+
+	shm_toc_insert(pcxt->toc, node->ss.ps.plan->plan_node_id, pstate);
+
+	/* The leader participates in the scan, too. */
+	node->pstate = pstate;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecBitmapHeapInitializeWorker
+ *
+ *		Attach to the shared state set up by the leader.
+ * ----------------------------------------------------------------
+ */
+void
+ExecBitmapHeapInitializeWorker(BitmapHeapScanState *node, shm_toc *toc)
+{
+	ParallelBitmapHeapState pstate;
+
+	pstate = shm_toc_lookup(toc, node->ss.ps.plan->plan_node_id);
+	if (pstate == NULL)
+		elog(ERROR, "could not find parallel bitmap heap scan state for plan node %d",
+			 node->ss.ps.plan->plan_node_id);
+	node->pstate = pstate;
+}
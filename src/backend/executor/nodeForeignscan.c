@@ -19,6 +19,11 @@
  *		ExecInitForeignScan		creates and initializes state info.
  *		ExecReScanForeignScan	rescans the foreign relation.
  *		ExecEndForeignScan		releases any resources allocated.
+ *		ExecForeignScanAsyncCapable	can the scan be run asynchronously?
+ *		ExecForeignScanAsyncReady	can the scan return a tuple without waiting?
+ *		ExecForeignScanEstimate		estimates DSM space for a parallel scan.
+ *		ExecForeignScanInitializeDSM	sets up the shared state of a parallel scan.
+ *		ExecForeignScanInitializeWorker	attaches a worker to the shared state.
  */
 #include "postgres.h"
 
@@ -47,7 +52,10 @@ ForeignNext(ForeignScanState *node)
 
 	/* Call the Iterate function in short-lived context */
 	oldcontext = MemoryContextSwitchTo(econtext->ecxt_per_tuple_memory);
-	slot = node->fdwroutine->IterateForeignScan(node);
+	if (plan->operation != CMD_SELECT)
+		slot = node->fdwroutine->IterateDirectModify(node);
+	else
+		slot = node->fdwroutine->IterateForeignScan(node);
 	MemoryContextSwitchTo(oldcontext);
 
 	/*
@@ -191,9 +199,12 @@ ExecInitForeignScan(ForeignScan *node, EState *estate, int eflags)
 	scanstate->fdw_state = NULL;
 
 	/*
-	 * Tell the FDW to initialize the scan.
+	 * Tell the FDW to initialize the scan, or the direct modification.
 	 */
-	fdwroutine->BeginForeignScan(scanstate, eflags);
+	if (node->operation != CMD_SELECT)
+		fdwroutine->BeginDirectModify(scanstate, eflags);
+	else
+		fdwroutine->BeginForeignScan(scanstate, eflags);
 
 	return scanstate;
 }
@@ -207,8 +218,13 @@ ExecInitForeignScan(ForeignScan *node, EState *estate, int eflags)
 void
 ExecEndForeignScan(ForeignScanState *node)
 {
+	ForeignScan *plan = (ForeignScan *) node->ss.ps.plan;
+
 	/* Let the FDW shut down */
-	node->fdwroutine->EndForeignScan(node);
+	if (plan->operation != CMD_SELECT)
+		node->fdwroutine->EndDirectModify(node);
+	else
+		node->fdwroutine->EndForeignScan(node);
 
 	/* Free the exprcontext */
 	ExecFreeExprContext(&node->ss.ps);
@@ -235,3 +251,120 @@ ExecReScanForeignScan(ForeignScanState *node)
 
 	ExecScanReScan(&node->ss);
 }
+
+/* ----------------------------------------------------------------
+ *		ExecForeignScanAsyncCapable
+ *
+ *		Returns true if the FDW can run the scan asynchronously, that is,
+ *		fetch its tuples in the background while other nodes run.  Append
+ *		uses this to fetch from several foreign scans at once.
+ * ----------------------------------------------------------------
+ */
+bool
+ExecForeignScanAsyncCapable(ForeignScanState *node)
+{
+	FdwRoutine *fdwroutine = node->fdwroutine;
+
+	if (((ForeignScan *) node->ss.ps.plan)->operation != CMD_SELECT)
+		return false;
+	if (fdwroutine->IsForeignScanAsyncCapable == NULL ||
+		fdwroutine->ForeignAsyncReady == NULL)
+		return false;
+	return fdwroutine->IsForeignScanAsyncCapable(node);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecForeignScanAsyncReady
+ *
+ *		Returns true if the next ExecProcNode call on an asynchronous scan
+ *		can return a tuple, or the end of the scan, without waiting.
+ *		Otherwise, the FDW starts fetching more tuples if it isn't doing so
+ *		already, and *waitsock is set to the socket to wait for before
+ *		asking again.
+ * ----------------------------------------------------------------
+ */
+bool
+ExecForeignScanAsyncReady(ForeignScanState *node, pgsocket *waitsock)
+{
+	ExprContext *econtext = node->ss.ps.ps_ExprContext;
+	MemoryContext oldcontext;
+	bool		ready;
+
+	*waitsock = PGINVALID_SOCKET;
+
+	oldcontext = MemoryContextSwitchTo(econtext->ecxt_per_tuple_memory);
+	ready = node->fdwroutine->ForeignAsyncReady(node, waitsock);
+	MemoryContextSwitchTo(oldcontext);
+
+	return ready;
+}
+
+/* ----------------------------------------------------------------
+ *						Parallel Scan Support
+ * ----------------------------------------------------------------
+ */
+
+/* ----------------------------------------------------------------
+ *		ExecForeignScanEstimate
+ *
+ *		Informs size of the parallel coordination information, if any
+ * ----------------------------------------------------------------
+ */
+void
+ExecForeignScanEstimate(ForeignScanState *node, ParallelContext *pcxt)
+{
+	FdwRoutine *fdwroutine = node->fdwroutine;
+
+	if (fdwroutine->EstimateDSMForeignScan)
+	{
+		node->pscan_len = fdwroutine->EstimateDSMForeignScan(node, pcxt);
+		shm_toc_estimate_chunk(&pcxt->estimator, node->pscan_len);
+		shm_toc_estimate_keys(&pcxt->estimator, 1);
+	}
+}
+
+/* ----------------------------------------------------------------
+ *		ExecForeignScanInitializeDSM
+ *
+ *		Initialize the parallel coordination information
+ * ----------------------------------------------------------------
+ */
+void
+ExecForeignScanInitializeDSM(ForeignScanState *node, ParallelContext *pcxt)
+{
+	FdwRoutine *fdwroutine = node->fdwroutine;
+
+	if (fdwroutine->InitializeDSMForeignScan)
+	{
+		int			plan_node_id = node->ss.ps.plan->plan_node_id;
+		void	   *coordinate;
+
+		coordinate = shm_toc_allocate(pcxt->toc, node->pscan_len);
+		fdwroutine->InitializeDSMForeignScan(node, pcxt, coordinate);
+		shm_toc_insert(pcxt->toc, plan_node_id, coordinate);
+	}
+}
+
+/* ----------------------------------------------------------------
+ *		ExecForeignScanInitializeWorker
+ *
+ *		Initialization according to the parallel coordination information
+ * ----------------------------------------------------------------
+ */
+void
+ExecForeignScanInitializeWorker(ForeignScanState *node, shm_toc *toc)
+{
+	FdwRoutine *fdwroutine = node->fdwroutine;
+
+	if (fdwroutine->InitializeWorkerForeignScan)
+	{
+		int			plan_node_id = node->ss.ps.plan->plan_node_id;
+		void	   *coordinate;
+
+		coordinate = shm_toc_lookup(toc, plan_node_id);
+		if (coordinate == NULL)
+			elog(ERROR, "could not find parallel scan state for plan node %d",
+				 plan_node_id);
+		fdwroutine->InitializeWorkerForeignScan(node, toc, coordinate);
+	}
+}
@@ -0,0 +1,387 @@
+/*-------------------------------------------------------------------------
+ *
+ * nodeGather.c
+ *	  Support routines for scanning a plan via multiple workers.
+ *
+ * A Gather executor launches parallel workers to run multiple copies of a
+ * plan.  It also runs the plan itself, so that it does useful work while
+ * the workers start up, and so that the query still completes if no workers
+ * are available.  It then merges all of the results it produces and the
+ * results from the workers into a single output stream, in no particular
+ * order.  Therefore, it must be used with a plan where running multiple
+ * copies of the same plan does not produce duplicate output, such as a
+ * parallel-aware SeqScan.
+ *
+ * If we are not in parallel mode (for instance because the query is being
+ * run a few rows at a time), the Gather node simply runs the plan locally.
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * IDENTIFICATION
+ *	  src/backend/executor/nodeGather.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/xact.h"
+#include "executor/execParallel.h"
+#include "executor/executor.h"
+#include "executor/nodeGather.h"
+#include "executor/tqueue.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+
+
+static TupleTableSlot *gather_getnext(GatherState *gatherstate);
+static HeapTuple gather_readnext(GatherState *gatherstate);
+static void ExecShutdownGatherWorkers(GatherState *node);
+
+
+/* ----------------------------------------------------------------
+ *		ExecInitGather
+ * ----------------------------------------------------------------
+ */
+GatherState *
+ExecInitGather(Gather *node, EState *estate, int eflags)
+{
+	GatherState *gatherstate;
+	Plan	   *outerNode;
+	TupleDesc	tupDesc;
+
+	/* Gather node doesn't have innerPlan node. */
+	Assert(innerPlan(node) == NULL);
+
+	/* check for unsupported flags */
+	Assert(!(eflags & (EXEC_FLAG_BACKWARD | EXEC_FLAG_MARK)));
+
+	/*
+	 * create state structure
+	 */
+	gatherstate = makeNode(GatherState);
+	gatherstate->ps.plan = (Plan *) node;
+	gatherstate->ps.state = estate;
+	gatherstate->initialized = false;
+	gatherstate->pei = NULL;
+	gatherstate->nreaders = 0;
+	gatherstate->nextreader = 0;
+	gatherstate->reader = NULL;
+	gatherstate->need_to_scan_locally = true;
+
+	/*
+	 * Miscellaneous initialization
+	 *
+	 * Gather nodes never call ExecQual or ExecProject, so they need no
+	 * ExprContext.
+	 */
+
+	/*
+	 * tuple table initialization
+	 */
+	gatherstate->funnel_slot = ExecInitExtraTupleSlot(estate);
+	ExecInitResultTupleSlot(estate, &gatherstate->ps);
+
+	/*
+	 * now initialize outer plan
+	 */
+	outerNode = outerPlan(node);
+	outerPlanState(gatherstate) = ExecInitNode(outerNode, estate, eflags);
+
+	/*
+	 * Gather nodes do no projections, so initialize projection info for this
+	 * node appropriately
+	 */
+	ExecAssignResultTypeFromTL(&gatherstate->ps);
+	gatherstate->ps.ps_ProjInfo = NULL;
+
+	/*
+	 * Tuples read from workers are stored in funnel_slot, which has the same
+	 * descriptor as the subplan's output.
+	 */
+	tupDesc = ExecGetResultType(outerPlanState(gatherstate));
+	ExecSetSlotDescriptor(gatherstate->funnel_slot, tupDesc);
+
+	return gatherstate;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecGather(node)
+ *
+ *		Scans the relation via multiple workers and returns
+ *		the next qualifying tuple.
+ * ----------------------------------------------------------------
+ */
+TupleTableSlot *
+ExecGather(GatherState *node)
+{
+	int			i;
+
+	/*
+	 * Initialize the parallel context and workers on first execution.  We do
+	 * this on first execution rather than during node initialization, as it
+	 * needs to allocate a large dynamic segment, so it is better to do it only
+	 * if it is really needed.
+	 */
+	if (!node->initialized)
+	{
+		EState	   *estate = node->ps.state;
+		Gather	   *gather = (Gather *) node->ps.plan;
+
+		/*
+		 * Sometimes we might have to run without parallelism; but if parallel
+		 * mode is active then we can try to fire up some workers.
+		 */
+		if (gather->num_workers > 0 && IsInParallelMode())
+		{
+			ParallelContext *pcxt;
+
+			/* Initialize the workers required to execute Gather node. */
+			node->pei = ExecInitParallelPlan(node->ps.lefttree,
+											 estate,
+											 gather->num_workers);
+
+			/*
+			 * Register backend workers. We might not get as many as we
+			 * requested, or indeed any at all.
+			 */
+			pcxt = node->pei->pcxt;
+			LaunchParallelWorkers(pcxt);
+
+			/* Set up tuple queue readers to read the results. */
+			if (pcxt->nworkers_launched > 0)
+			{
+				node->nreaders = 0;
+				node->reader =
+					palloc(pcxt->nworkers_launched * sizeof(TupleQueueReader *));
+
+				for (i = 0; i < pcxt->nworkers_launched; ++i)
+				{
+					shm_mq_set_handle(node->pei->tqueue[i],
+									  pcxt->worker[i].bgwhandle);
+					node->reader[node->nreaders++] =
+						CreateTupleQueueReader(node->pei->tqueue[i]);
+				}
+			}
+		}
+
+		/* Run plan locally too, so the leader isn't idle. */
+		node->need_to_scan_locally = true;
+		node->initialized = true;
+	}
+
+	return gather_getnext(node);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecEndGather
+ *
+ *		frees any storage allocated through C routines.
+ * ----------------------------------------------------------------
+ */
+void
+ExecEndGather(GatherState *node)
+{
+	ExecShutdownGather(node);
+	ExecClearTuple(node->funnel_slot);
+	ExecClearTuple(node->ps.ps_ResultTupleSlot);
+	ExecEndNode(outerPlanState(node));
+}
+
+/*
+ * gather_getnext
+ *
+ * Read the next tuple, either from a worker or from the local copy of the
+ * plan.  We alternate between the two so that neither the workers nor the
+ * leader are starved.
+ */
+static TupleTableSlot *
+gather_getnext(GatherState *gatherstate)
+{
+	PlanState  *outerPlan = outerPlanState(gatherstate);
+	TupleTableSlot *outerTupleSlot;
+	TupleTableSlot *fslot = gatherstate->funnel_slot;
+	HeapTuple	tup;
+
+	while (gatherstate->nreaders > 0 || gatherstate->need_to_scan_locally)
+	{
+		if (gatherstate->nreaders > 0)
+		{
+			tup = gather_readnext(gatherstate);
+
+			if (HeapTupleIsValid(tup))
+			{
+				ExecStoreTuple(tup,		/* tuple to store */
+							   fslot,	/* slot in which to store the tuple */
+							   InvalidBuffer,	/* buffer associated with this
+												 * tuple */
+							   true);	/* pfree this pointer if not from heap */
+
+				return fslot;
+			}
+		}
+
+		if (gatherstate->need_to_scan_locally)
+		{
+			outerTupleSlot = ExecProcNode(outerPlan);
+
+			if (!TupIsNull(outerTupleSlot))
+				return outerTupleSlot;
+
+			gatherstate->need_to_scan_locally = false;
+		}
+		else if (gatherstate->nreaders > 0)
+		{
+			/*
+			 * Nothing to do locally and nothing ready from the workers; wait
+			 * for one of them to send us something.
+			 */
+			pgstat_report_wait_start(WAIT_EVENT_EXECUTE_GATHER);
+			WaitLatch(MyLatch, WL_LATCH_SET, 0);
+			pgstat_report_wait_end();
+			CHECK_FOR_INTERRUPTS();
+			ResetLatch(MyLatch);
+		}
+	}
+
+	return ExecClearTuple(fslot);
+}
+
+/*
+ * gather_readnext
+ *
+ * Make one pass over the tuple queues, starting with the one after the queue
+ * we last read from, and return the first tuple found.  Returns NULL if no
+ * queue has a tuple ready.  Queues whose workers have finished are removed;
+ * once all of them are gone, we wait for the workers to exit so that any
+ * errors they threw get reported.
+ */
+static HeapTuple
+gather_readnext(GatherState *gatherstate)
+{
+	int			visited = 0;
+
+	while (gatherstate->nreaders > 0 && visited < gatherstate->nreaders)
+	{
+		TupleQueueReader *reader;
+		HeapTuple	tup;
+		bool		readerdone;
+
+		reader = gatherstate->reader[gatherstate->nextreader];
+		tup = TupleQueueReaderNext(reader, true, &readerdone);
+
+		/*
+		 * If this reader is done, remove it.  If all readers are done, clean
+		 * up remaining worker state.
+		 */
+		if (readerdone)
+		{
+			DestroyTupleQueueReader(reader);
+			--gatherstate->nreaders;
+			if (gatherstate->nreaders == 0)
+			{
+				ExecShutdownGatherWorkers(gatherstate);
+				return NULL;
+			}
+			memmove(&gatherstate->reader[gatherstate->nextreader],
+					&gatherstate->reader[gatherstate->nextreader + 1],
+					sizeof(TupleQueueReader *)
+					* (gatherstate->nreaders - gatherstate->nextreader));
+			if (gatherstate->nextreader >= gatherstate->nreaders)
+				gatherstate->nextreader = 0;
+			continue;
+		}
+
+		/* Advance nextreader pointer in round-robin fashion. */
+		gatherstate->nextreader =
+			(gatherstate->nextreader + 1) % gatherstate->nreaders;
+
+		if (tup != NULL)
+			return tup;
+
+		visited++;
+	}
+
+	return NULL;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecShutdownGatherWorkers
+ *
+ *		Destroy the tuple queue readers and, if every worker has already
+ *		reported that it is done, wait for the workers to exit.
+ * ----------------------------------------------------------------
+ */
+static void
+ExecShutdownGatherWorkers(GatherState *node)
+{
+	bool		all_done = (node->nreaders == 0);
+	int			i;
+
+	/* Detaching from the queues tells any remaining workers to stop. */
+	for (i = 0; i < node->nreaders; ++i)
+		DestroyTupleQueueReader(node->reader[i]);
+	node->nreaders = 0;
+
+	if (node->reader != NULL)
+	{
+		pfree(node->reader);
+		node->reader = NULL;
+	}
+
+	/*
+	 * If the workers ran to completion, collect any errors they may have
+	 * thrown.  Otherwise we don't care how they finish; destroying the
+	 * parallel context will terminate them.
+	 */
+	if (all_done && node->pei != NULL)
+		ExecParallelFinish(node->pei);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecShutdownGather
+ *
+ *		Destroy the setup for parallel workers including parallel context.
+ *		This is called once the node's output is no longer needed, which
+ *		may be before the workers have finished.
+ * ----------------------------------------------------------------
+ */
+void
+ExecShutdownGather(GatherState *node)
+{
+	ExecShutdownGatherWorkers(node);
+
+	/* Now destroy the parallel context. */
+	if (node->pei != NULL)
+	{
+		ExecParallelCleanup(node->pei);
+		node->pei = NULL;
+	}
+}
+
+/* ----------------------------------------------------------------
+ *						Join Support
+ * ----------------------------------------------------------------
+ */
+
+/* ----------------------------------------------------------------
+ *		ExecReScanGather
+ *
+ *		Shut down the workers and rescan the relation via a new set.
+ * ----------------------------------------------------------------
+ */
+void
+ExecReScanGather(GatherState *node)
+{
+	/*
+	 * Get rid of the current set of workers and their dynamic shared memory
+	 * segment.  A fresh set will be launched, with freshly initialized shared
+	 * scan state, on the next call to ExecGather.
+	 */
+	ExecShutdownGather(node);
+
+	node->initialized = false;
+
+	ExecReScan(node->ps.lefttree);
+}
@@ -17,6 +17,8 @@
  *		MultiExecHash	- generate an in-memory hash table of the relation
  *		ExecInitHash	- initialize node and subnodes
  *		ExecEndHash		- shutdown node and subnodes
+ *		ExecHashEstimate, ExecHashInitializeDSM, ExecHashInitializeWorker
+ *						- set up a hash table shared by parallel workers
  */
 
 #include "postgres.h"
@@ -31,7 +33,11 @@
 #include "executor/hashjoin.h"
 #include "executor/nodeHash.h"
 #include "executor/nodeHashjoin.h"
+#include "lib/bloomfilter.h"
 #include "miscadmin.h"
+#include "pgstat.h"
+#include "storage/latch.h"
+#include "storage/proc.h"
 #include "utils/dynahash.h"
 #include "utils/memutils.h"
 #include "utils/lsyscache.h"
@@ -50,6 +56,29 @@ static void ExecHashRemoveNextSkewBucket(HashJoinTable hashtable);
 
 static void *dense_alloc(HashJoinTable hashtable, Size size);
 
+static void ExecHashBuildShared(HashState *node);
+static bool ExecHashTableInsertShared(HashJoinTable hashtable,
+						  TupleTableSlot *slot,
+						  uint32 hashvalue);
+static void *shared_dense_alloc(HashJoinTable hashtable, Size size);
+static void *shared_arena_alloc(SharedHashJoinTable shared, Size size);
+static bool ExecScanSharedHashBucket(HashJoinState *hjstate,
+						 ExprContext *econtext);
+static Size ExecHashSharedTableLayout(HashState *node, int nparticipants,
+						  SharedHashJoinTable shared);
+
+
+/*
+ * Push a tuple onto the front of a bucket's list, and add its tag bit
+ */
+static inline void
+ExecHashBucketPush(HashJoinBucketData *bucket, HashJoinTuple hashTuple)
+{
+	hashTuple->next = bucket->tuples;
+	bucket->tuples = hashTuple;
+	bucket->tags |= HJ_HASH_TAG(hashTuple->hashvalue);
+}
+
 /* ----------------------------------------------------------------
  *		ExecHash
  *
@@ -90,6 +119,19 @@ MultiExecHash(HashState *node)
 	outerNode = outerPlanState(node);
 	hashtable = node->hashtable;
 
+	/*
+	 * A hash table in shared memory is built by all participants together.
+	 */
+	if (hashtable->shared != NULL)
+	{
+		ExecHashBuildShared(node);
+
+		/* must provide our own instrumentation support */
+		if (node->ps.instrument)
+			InstrStopNode(node->ps.instrument, hashtable->totalTuples);
+		return NULL;
+	}
+
 	/*
 	 * set expression context
 	 */
@@ -112,6 +154,9 @@ MultiExecHash(HashState *node)
 		{
 			int			bucketNumber;
 
+			if (hashtable->bloomfilter)
+				bloom_add_hash(hashtable->bloomfilter, hashvalue);
+
 			bucketNumber = ExecHashGetSkewBucket(hashtable, hashvalue);
 			if (bucketNumber != INVALID_SKEW_BUCKET_NO)
 			{
@@ -144,7 +189,7 @@ MultiExecHash(HashState *node)
 	}
 
 	/* Account for the buckets in spaceUsed (reported in EXPLAIN ANALYZE) */
-	hashtable->spaceUsed += hashtable->nbuckets * sizeof(HashJoinTuple);
+	hashtable->spaceUsed += hashtable->nbuckets * sizeof(HashJoinBucketData);
 	if (hashtable->spaceUsed > hashtable->spacePeak)
 		hashtable->spacePeak = hashtable->spaceUsed;
 
@@ -170,6 +215,24 @@ MultiExecHash(HashState *node)
  */
 HashState *
 ExecInitHash(Hash *node, EState *estate, int eflags)
+{
+	return ExecInitHashOverState(node, estate, eflags, NULL);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecInitHashOverState
+ *
+ *		Like ExecInitHash, but if childState isn't NULL, use that as the
+ *		already initialized state of our child plan instead of
+ *		initializing it ourselves.  This is for a nestloop switching to a
+ *		hash join over its own inner child; the caller is responsible for
+ *		shutting down the child, so such a node must never be passed to
+ *		ExecEndNode.
+ * ----------------------------------------------------------------
+ */
+HashState *
+ExecInitHashOverState(Hash *node, EState *estate, int eflags,
+					  PlanState *childState)
 {
 	HashState  *hashstate;
 
@@ -184,6 +247,7 @@ ExecInitHash(Hash *node, EState *estate, int eflags)
 	hashstate->ps.state = estate;
 	hashstate->hashtable = NULL;
 	hashstate->hashkeys = NIL;	/* will be set by parent HashJoin */
+	hashstate->shared_table = NULL;
 
 	/*
 	 * Miscellaneous initialization
@@ -210,7 +274,11 @@ ExecInitHash(Hash *node, EState *estate, int eflags)
 	/*
 	 * initialize child nodes
 	 */
-	outerPlanState(hashstate) = ExecInitNode(outerPlan(node), estate, eflags);
+	if (childState != NULL)
+		outerPlanState(hashstate) = childState;
+	else
+		outerPlanState(hashstate) = ExecInitNode(outerPlan(node), estate,
+												 eflags);
 
 	/*
 	 * initialize tuple type. no need to initialize projection info because
@@ -250,13 +318,18 @@ ExecEndHash(HashState *node)
  *		ExecHashTableCreate
  *
  *		create an empty hashtable data structure for hashjoin.
+ *
+ *		If the Hash node has been attached to a shared hash table, the
+ *		result merely refers to that table.
  * ----------------------------------------------------------------
  */
 HashJoinTable
-ExecHashTableCreate(Hash *node, List *hashOperators, bool keepNulls)
+ExecHashTableCreate(HashState *state, List *hashOperators, bool keepNulls)
 {
+	Hash	   *node = (Hash *) state->ps.plan;
 	HashJoinTable hashtable;
 	Plan	   *outerNode;
+	double		rows;
 	int			nbuckets;
 	int			nbatch;
 	int			num_skew_mcvs;
@@ -269,13 +342,29 @@ ExecHashTableCreate(Hash *node, List *hashOperators, bool keepNulls)
 	/*
 	 * Get information about the size of the relation to be hashed (it's the
 	 * "outer" subtree of this node, but the inner relation of the hashjoin).
-	 * Compute the appropriate size of the hash table.
+	 * Compute the appropriate size of the hash table.  A parallel-aware
+	 * subtree's row estimate covers only one participant's share, but if
+	 * we're hashing it privately we'll be reading all of it.
+	 *
+	 * A shared hash table has already been sized by ExecHashInitializeDSM,
+	 * and never has more than one batch.
 	 */
 	outerNode = outerPlan(node);
 
-	ExecChooseHashTableSize(outerNode->plan_rows, outerNode->plan_width,
-							OidIsValid(node->skewTable),
-							&nbuckets, &nbatch, &num_skew_mcvs);
+	if (state->shared_table != NULL)
+	{
+		nbuckets = state->shared_table->nbuckets;
+		nbatch = 1;
+		num_skew_mcvs = 0;
+	}
+	else
+	{
+		rows = node->plan.parallel_aware ? node->rows_total :
+			outerNode->plan_rows;
+		ExecChooseHashTableSize(rows, outerNode->plan_width,
+								OidIsValid(node->skewTable),
+								&nbuckets, &nbatch, &num_skew_mcvs);
+	}
 
 #ifdef HJDEBUG
 	printf("nbatch = %d, nbuckets = %d\n", nbatch, nbuckets);
@@ -320,6 +409,16 @@ ExecHashTableCreate(Hash *node, List *hashOperators, bool keepNulls)
 	hashtable->spaceAllowedSkew =
 		hashtable->spaceAllowed * SKEW_WORK_MEM_PERCENT / 100;
 	hashtable->chunks = NULL;
+	hashtable->shared = state->shared_table;
+	hashtable->sharedChunk = NULL;
+	hashtable->sharedChunkFree = 0;
+	hashtable->bloomfilter = NULL;
+	if (hashtable->shared != NULL)
+	{
+		/* the shared table's size is fixed, as is its number of buckets */
+		hashtable->growEnabled = false;
+		hashtable->spaceAllowed = hashtable->shared->arena_size;
+	}
 
 	/*
 	 * Get info about the hash functions to be used for each hash key. Also
@@ -341,8 +440,18 @@ ExecHashTableCreate(Hash *node, List *hashOperators, bool keepNulls)
 		if (!get_op_hash_functions(hashop, &left_hashfn, &right_hashfn))
 			elog(ERROR, "could not find hash function for hash operator %u",
 				 hashop);
-		fmgr_info(left_hashfn, &hashtable->outer_hashfunctions[i]);
-		fmgr_info(right_hashfn, &hashtable->inner_hashfunctions[i]);
+		if (left_hashfn == right_hashfn)
+		{
+			execHashFunctionInfo(left_hashfn,
+								 &hashtable->outer_hashfunctions[i]);
+			execHashFunctionInfo(right_hashfn,
+								 &hashtable->inner_hashfunctions[i]);
+		}
+		else
+		{
+			fmgr_info(left_hashfn, &hashtable->outer_hashfunctions[i]);
+			fmgr_info(right_hashfn, &hashtable->inner_hashfunctions[i]);
+		}
 		hashtable->hashStrict[i] = op_strict(hashop);
 		i++;
 	}
@@ -383,12 +492,14 @@ ExecHashTableCreate(Hash *node, List *hashOperators, bool keepNulls)
 
 	/*
 	 * Prepare context for the first-scan space allocations; allocate the
-	 * hashbucket array therein, and set each bucket "empty".
+	 * hashbucket array therein, and set each bucket "empty".  A shared table
+	 * has its buckets in shared memory instead.
 	 */
 	MemoryContextSwitchTo(hashtable->batchCxt);
 
-	hashtable->buckets = (HashJoinTuple *)
-		palloc0(nbuckets * sizeof(HashJoinTuple));
+	if (hashtable->shared == NULL)
+		hashtable->buckets = (HashJoinBucketData *)
+			palloc0(nbuckets * sizeof(HashJoinBucketData));
 
 	/*
 	 * Set up for skew optimization, if possible and there's a need for more
@@ -490,14 +601,14 @@ ExecChooseHashTableSize(double ntuples, int tupwidth, bool useskew,
 	 * results so that the pointer arrays we'll try to allocate do not exceed
 	 * work_mem.
 	 */
-	max_pointers = (work_mem * 1024L) / sizeof(void *);
+	max_pointers = (work_mem * 1024L) / sizeof(HashJoinBucketData);
 	/* also ensure we avoid integer overflow in nbatch and nbuckets */
 	max_pointers = Min(max_pointers, INT_MAX / 2);
 	dbuckets = ceil(ntuples / NTUP_PER_BUCKET);
 	dbuckets = Min(dbuckets, max_pointers);
 	nbuckets = Max((int) dbuckets, 1024);
 	nbuckets = 1 << my_log2(nbuckets);
-	bucket_bytes = sizeof(HashJoinTuple) * nbuckets;
+	bucket_bytes = sizeof(HashJoinBucketData) * nbuckets;
 
 	/*
 	 * If there's not enough space to store the projected number of tuples and
@@ -513,23 +624,23 @@ ExecChooseHashTableSize(double ntuples, int tupwidth, bool useskew,
 
 		/*
 		 * Estimate the number of buckets we'll want to have when work_mem is
-		 * entirely full.  Each bucket will contain a bucket pointer plus
+		 * entirely full.  Each bucket will contain a bucket header plus
 		 * NTUP_PER_BUCKET tuples, whose projected size already includes
 		 * overhead for the hash code, pointer to the next tuple, etc.
 		 */
-		bucket_size = (tupsize * NTUP_PER_BUCKET + sizeof(HashJoinTuple));
+		bucket_size = (tupsize * NTUP_PER_BUCKET + sizeof(HashJoinBucketData));
 		lbuckets = 1 << my_log2(hash_table_bytes / bucket_size);
 		lbuckets = Min(lbuckets, max_pointers);
 		nbuckets = (int) lbuckets;
-		bucket_bytes = nbuckets * sizeof(HashJoinTuple);
+		bucket_bytes = nbuckets * sizeof(HashJoinBucketData);
 
 		/*
-		 * Buckets are simple pointers to hashjoin tuples, while tupsize
-		 * includes the pointer, hash code, and MinimalTupleData.  So buckets
-		 * should never really exceed 25% of work_mem (even for
-		 * NTUP_PER_BUCKET=1); except maybe for work_mem values that are not
-		 * 2^N bytes, where we might get more because of doubling. So let's
-		 * look for 50% here.
+		 * Bucket headers are just a pointer to hashjoin tuples plus the tag
+		 * bits, while tupsize includes the pointer, hash code, and
+		 * MinimalTupleData.  So buckets should never really exceed about a
+		 * third of work_mem (even for NTUP_PER_BUCKET=1); except maybe for
+		 * work_mem values that are not 2^N bytes, where we might get more
+		 * because of doubling. So let's look for 50% here.
 		 */
 		Assert(bucket_bytes <= hash_table_bytes / 2);
 
@@ -546,6 +657,100 @@ ExecChooseHashTableSize(double ntuples, int tupwidth, bool useskew,
 	*numbatches = nbatch;
 }
 
+/*
+ * Compute the number of buckets and the size of the tuple arena for a hash
+ * table shared by nparticipants processes, given the estimated total size
+ * of the relation to be hashed.  Such a table may use the combined work_mem
+ * of all the participants, but can't be split into batches; we return false
+ * if the relation is not expected to fit.
+ *
+ * This is exported so that the planner's joinpath.c can use it.
+ */
+bool
+ExecChooseSharedHashTableSize(double ntuples, int tupwidth,
+							  int nparticipants,
+							  int *numbuckets,
+							  Size *arenasize)
+{
+	int			tupsize;
+	double		inner_rel_bytes;
+	double		hash_table_bytes;
+	double		bucket_bytes;
+	double		dbuckets;
+	int			nbuckets;
+
+	/* Force a plausible relation size if no info */
+	if (ntuples <= 0.0)
+		ntuples = 1000.0;
+
+	tupsize = SHJTUPLE_OVERHEAD +
+		MAXALIGN(SizeofMinimalTupleHeader) +
+		MAXALIGN(tupwidth);
+	inner_rel_bytes = ntuples * tupsize;
+
+	/*
+	 * The participants pool their work_mem allowances.  Tuples are linked by
+	 * 32-bit offsets counted in MAXIMUM_ALIGNOF units, which limits the size
+	 * of the arena.
+	 */
+	hash_table_bytes = (double) work_mem * 1024.0 * nparticipants;
+	hash_table_bytes = Min(hash_table_bytes,
+						   (double) PG_UINT32_MAX * MAXIMUM_ALIGNOF);
+	hash_table_bytes = Min(hash_table_bytes, (double) MaxAllocHugeSize);
+
+	/*
+	 * Aim for an average bucket load of NTUP_PER_BUCKET, but don't let the
+	 * bucket array take more than a quarter of the memory.  Unlike a private
+	 * table, a shared one can't add buckets on the fly.
+	 */
+	dbuckets = ceil(ntuples / NTUP_PER_BUCKET);
+	dbuckets = Min(dbuckets,
+				   hash_table_bytes / (4 * sizeof(pg_atomic_uint32)));
+	dbuckets = Min(dbuckets, INT_MAX / 2);
+	nbuckets = Max((int) dbuckets, 1024);
+	nbuckets = 1 << my_log2(nbuckets);
+	bucket_bytes = (double) nbuckets * sizeof(pg_atomic_uint32);
+
+	/*
+	 * Leave some slack for misestimation, and for the partly-filled chunk
+	 * each participant may be left holding, but don't go past the limit.
+	 * Shared memory isn't necessarily allocated lazily, so it's not a good
+	 * idea to reserve the whole limit regardless of the estimate.
+	 */
+	*numbuckets = nbuckets;
+	*arenasize = (Size) Min(2 * inner_rel_bytes +
+							(double) nparticipants * HASH_CHUNK_SIZE,
+							hash_table_bytes - bucket_bytes);
+
+	return inner_rel_bytes + bucket_bytes <= hash_table_bytes;
+}
+
+
+/* ----------------------------------------------------------------
+ *		ExecHashTableCreateBloomFilter
+ *
+ *		make MultiExecHash add the hash value of every inner tuple to a
+ *		Bloom filter, for testing outer tuples before they reach the join
+ *
+ * The filter lives in the hash table's memory context, so it goes away
+ * with the table.  It isn't counted in spaceUsed; instead it's limited to
+ * a quarter of work_mem, which at about one byte per inner tuple is much
+ * less than the tuples themselves take anyway.  A shared table is built by
+ * several processes, each seeing only some of the inner tuples, so it
+ * can't have a filter.
+ * ----------------------------------------------------------------
+ */
+void
+ExecHashTableCreateBloomFilter(HashJoinTable hashtable, double ntuples)
+{
+	MemoryContext oldcxt;
+
+	Assert(hashtable->shared == NULL);
+
+	oldcxt = MemoryContextSwitchTo(hashtable->hashCxt);
+	hashtable->bloomfilter = bloom_create(ntuples, work_mem / 4);
+	MemoryContextSwitchTo(oldcxt);
+}
 
 /* ----------------------------------------------------------------
  *		ExecHashTableDestroy
@@ -655,15 +860,17 @@ ExecHashIncreaseNumBatches(HashJoinTable hashtable)
 		hashtable->log2_nbuckets = hashtable->log2_nbuckets_optimal;
 
 		hashtable->buckets = repalloc(hashtable->buckets,
-								sizeof(HashJoinTuple) * hashtable->nbuckets);
+							sizeof(HashJoinBucketData) * hashtable->nbuckets);
 	}
 
 	/*
 	 * We will scan through the chunks directly, so that we can reset the
 	 * buckets now and not have to keep track which tuples in the buckets have
-	 * already been processed. We will free the old chunks as we go.
+	 * already been processed. We will free the old chunks as we go.  This
+	 * also gets rid of any stale tag bits.
 	 */
-	memset(hashtable->buckets, 0, sizeof(HashJoinTuple) * hashtable->nbuckets);
+	memset(hashtable->buckets, 0,
+		   sizeof(HashJoinBucketData) * hashtable->nbuckets);
 	oldchunks = hashtable->chunks;
 	hashtable->chunks = NULL;
 
@@ -697,8 +904,7 @@ ExecHashIncreaseNumBatches(HashJoinTable hashtable)
 				memcpy(copyTuple, hashTuple, hashTupleSize);
 
 				/* and add it back to the appropriate bucket */
-				copyTuple->next = hashtable->buckets[bucketno];
-				hashtable->buckets[bucketno] = copyTuple;
+				ExecHashBucketPush(&hashtable->buckets[bucketno], copyTuple);
 			}
 			else
 			{
@@ -779,10 +985,11 @@ ExecHashIncreaseNumBuckets(HashJoinTable hashtable)
 	 * chunks)
 	 */
 	hashtable->buckets =
-		(HashJoinTuple *) repalloc(hashtable->buckets,
-								hashtable->nbuckets * sizeof(HashJoinTuple));
+		(HashJoinBucketData *) repalloc(hashtable->buckets,
+						   hashtable->nbuckets * sizeof(HashJoinBucketData));
 
-	memset(hashtable->buckets, 0, sizeof(void *) * hashtable->nbuckets);
+	memset(hashtable->buckets, 0,
+		   sizeof(HashJoinBucketData) * hashtable->nbuckets);
 
 	/* scan through all tuples in all chunks to rebuild the hash table */
 	for (chunk = hashtable->chunks; chunk != NULL; chunk = chunk->next)
@@ -800,8 +1007,7 @@ ExecHashIncreaseNumBuckets(HashJoinTable hashtable)
 									  &bucketno, &batchno);
 
 			/* add the tuple to the proper bucket */
-			hashTuple->next = hashtable->buckets[bucketno];
-			hashtable->buckets[bucketno] = hashTuple;
+			ExecHashBucketPush(&hashtable->buckets[bucketno], hashTuple);
 
 			/* advance index past the tuple */
 			idx += MAXALIGN(HJTUPLE_OVERHEAD +
@@ -867,8 +1073,7 @@ ExecHashTableInsert(HashJoinTable hashtable,
 		HeapTupleHeaderClearMatch(HJTUPLE_MINTUPLE(hashTuple));
 
 		/* Push it onto the front of the bucket's list */
-		hashTuple->next = hashtable->buckets[bucketno];
-		hashtable->buckets[bucketno] = hashTuple;
+		ExecHashBucketPush(&hashtable->buckets[bucketno], hashTuple);
 
 		/*
 		 * Increase the (optimal) number of buckets if we just exceeded the
@@ -888,7 +1093,7 @@ ExecHashTableInsert(HashJoinTable hashtable,
 		if (hashtable->spaceUsed > hashtable->spacePeak)
 			hashtable->spacePeak = hashtable->spaceUsed;
 		if (hashtable->spaceUsed +
-			hashtable->nbuckets_optimal * sizeof(HashJoinTuple)
+			hashtable->nbuckets_optimal * sizeof(HashJoinBucketData)
 			> hashtable->spaceAllowed)
 			ExecHashIncreaseNumBatches(hashtable);
 	}
@@ -1062,6 +1267,9 @@ ExecScanHashBucket(HashJoinState *hjstate,
 	HashJoinTuple hashTuple = hjstate->hj_CurTuple;
 	uint32		hashvalue = hjstate->hj_CurHashValue;
 
+	if (hashtable->shared != NULL)
+		return ExecScanSharedHashBucket(hjstate, econtext);
+
 	/*
 	 * hj_CurTuple is the address of the tuple last returned from the current
 	 * bucket, or NULL if it's time to start scanning a new bucket.
@@ -1074,10 +1282,24 @@ ExecScanHashBucket(HashJoinState *hjstate,
 	else if (hjstate->hj_CurSkewBucketNo != INVALID_SKEW_BUCKET_NO)
 		hashTuple = hashtable->skewBucket[hjstate->hj_CurSkewBucketNo]->tuples;
 	else
-		hashTuple = hashtable->buckets[hjstate->hj_CurBucketNo];
+	{
+		HashJoinBucketData *bucket = &hashtable->buckets[hjstate->hj_CurBucketNo];
+
+		/* skip the list altogether if no tuple in it can have our hash code */
+		if ((bucket->tags & HJ_HASH_TAG(hashvalue)) == 0)
+			return false;
+		hashTuple = bucket->tuples;
+	}
 
 	while (hashTuple != NULL)
 	{
+		/*
+		 * Start fetching the next tuple of the list, so that its cache miss
+		 * overlaps with testing this one.
+		 */
+		if (hashTuple->next != NULL)
+			pg_prefetch_mem(hashTuple->next);
+
 		if (hashTuple->hashvalue == hashvalue)
 		{
 			TupleTableSlot *inntuple;
@@ -1107,6 +1329,62 @@ ExecScanHashBucket(HashJoinState *hjstate,
 	return false;
 }
 
+/*
+ * ExecScanSharedHashBucket
+ *		ExecScanHashBucket for a hash table in shared memory
+ *
+ * On success, the inner tuple is stored into hjstate->hj_CurSharedTuple.
+ * There are no skew buckets to worry about.
+ */
+static bool
+ExecScanSharedHashBucket(HashJoinState *hjstate,
+						 ExprContext *econtext)
+{
+	List	   *hjclauses = hjstate->hashclauses;
+	SharedHashJoinTable shared = hjstate->hj_HashTable->shared;
+	SharedHashJoinTuple hashTuple = hjstate->hj_CurSharedTuple;
+	uint32		hashvalue = hjstate->hj_CurHashValue;
+	pg_atomic_uint32 *buckets = SharedHashJoinBuckets(shared);
+	uint32		next;
+
+	if (hashTuple != NULL)
+		next = hashTuple->next;
+	else
+		next = pg_atomic_read_u32(&buckets[hjstate->hj_CurBucketNo]);
+
+	while (next != 0)
+	{
+		hashTuple = SharedHashJoinTupleAt(shared, next);
+
+		if (hashTuple->hashvalue == hashvalue)
+		{
+			TupleTableSlot *inntuple;
+
+			/* insert hashtable's tuple into exec slot so ExecQual sees it */
+			inntuple = ExecStoreMinimalTuple(SHJTUPLE_MINTUPLE(hashTuple),
+											 hjstate->hj_HashTupleSlot,
+											 false);	/* do not pfree */
+			econtext->ecxt_innertuple = inntuple;
+
+			/* reset temp memory each time to avoid leaks from qual expr */
+			ResetExprContext(econtext);
+
+			if (ExecQual(hjclauses, econtext, false))
+			{
+				hjstate->hj_CurSharedTuple = hashTuple;
+				return true;
+			}
+		}
+
+		next = hashTuple->next;
+	}
+
+	/*
+	 * no match
+	 */
+	return false;
+}
+
 /*
  * ExecPrepHashTableForUnmatched
  *		set up for a series of ExecScanHashTableForUnmatched calls
@@ -1151,7 +1429,7 @@ ExecScanHashTableForUnmatched(HashJoinState *hjstate, ExprContext *econtext)
 			hashTuple = hashTuple->next;
 		else if (hjstate->hj_CurBucketNo < hashtable->nbuckets)
 		{
-			hashTuple = hashtable->buckets[hjstate->hj_CurBucketNo];
+			hashTuple = hashtable->buckets[hjstate->hj_CurBucketNo].tuples;
 			hjstate->hj_CurBucketNo++;
 		}
 		else if (hjstate->hj_CurSkewBucketNo < hashtable->nSkewBuckets)
@@ -1216,8 +1494,8 @@ ExecHashTableReset(HashJoinTable hashtable)
 	oldcxt = MemoryContextSwitchTo(hashtable->batchCxt);
 
 	/* Reallocate and reinitialize the hash bucket headers. */
-	hashtable->buckets = (HashJoinTuple *)
-		palloc0(nbuckets * sizeof(HashJoinTuple));
+	hashtable->buckets = (HashJoinBucketData *)
+		palloc0(nbuckets * sizeof(HashJoinBucketData));
 
 	hashtable->spaceUsed = 0;
 
@@ -1240,7 +1518,8 @@ ExecHashTableResetMatchFlags(HashJoinTable hashtable)
 	/* Reset all flags in the main table ... */
 	for (i = 0; i < hashtable->nbuckets; i++)
 	{
-		for (tuple = hashtable->buckets[i]; tuple != NULL; tuple = tuple->next)
+		for (tuple = hashtable->buckets[i].tuples; tuple != NULL;
+			 tuple = tuple->next)
 			HeapTupleHeaderClearMatch(HJTUPLE_MINTUPLE(tuple));
 	}
 
@@ -1567,8 +1846,7 @@ ExecHashRemoveNextSkewBucket(HashJoinTable hashtable)
 		if (batchno == hashtable->curbatch)
 		{
 			/* Move the tuple to the main hash table */
-			hashTuple->next = hashtable->buckets[bucketno];
-			hashtable->buckets[bucketno] = hashTuple;
+			ExecHashBucketPush(&hashtable->buckets[bucketno], hashTuple);
 			/* We have reduced skew space, but overall space doesn't change */
 			hashtable->spaceUsedSkew -= tupleSize;
 		}
@@ -1695,3 +1973,333 @@ dense_alloc(HashJoinTable hashtable, Size size)
 	/* return pointer to the start of the tuple memory */
 	return ptr;
 }
+
+/* ----------------------------------------------------------------
+ *						Shared Hash Table Support
+ * ----------------------------------------------------------------
+ */
+
+/*
+ * ExecHashBuildShared
+ *		MultiExecHash for a hash table in shared memory
+ *
+ * Unless the table has already been completed, we register as a builder,
+ * insert every tuple our (parallel-aware) subplan gives us, and then wait
+ * until all the other builders are done too.  Any participant that starts
+ * building after that point would find the subplan's shared scan exhausted
+ * anyway, so it may as well go straight to probing.
+ *
+ * If the table runs out of space, we stop inserting and leave it to our
+ * caller to notice "overflow" once the build is complete.
+ */
+static void
+ExecHashBuildShared(HashState *node)
+{
+	HashJoinTable hashtable = node->hashtable;
+	SharedHashJoinTable shared = hashtable->shared;
+	PlanState  *outerNode = outerPlanState(node);
+	List	   *hashkeys = node->hashkeys;
+	ExprContext *econtext = node->ps.ps_ExprContext;
+	TupleTableSlot *slot;
+	uint32		hashvalue;
+	bool		build;
+	bool		last = false;
+	int			i;
+
+	SpinLockAcquire(&shared->mutex);
+	build = !shared->build_done;
+	if (build)
+	{
+		Assert(shared->nbuilders < shared->maxparticipants);
+		shared->builders[shared->nbuilders++] = MyProc->pgprocno;
+		shared->nbuilding++;
+	}
+	SpinLockRelease(&shared->mutex);
+
+	if (build)
+	{
+		for (;;)
+		{
+			slot = ExecProcNode(outerNode);
+			if (TupIsNull(slot))
+				break;
+			/* We have to compute the hash value */
+			econtext->ecxt_innertuple = slot;
+			if (ExecHashGetHashValue(hashtable, econtext, hashkeys,
+									 false, hashtable->keepNulls,
+									 &hashvalue))
+			{
+				if (!ExecHashTableInsertShared(hashtable, slot, hashvalue))
+					break;		/* out of space */
+				hashtable->totalTuples += 1;
+			}
+		}
+
+		SpinLockAcquire(&shared->mutex);
+		shared->totalTuples += hashtable->totalTuples;
+		if (--shared->nbuilding == 0)
+		{
+			shared->build_done = true;
+			last = true;
+		}
+		SpinLockRelease(&shared->mutex);
+
+		/*
+		 * If we were the last builder, wake up the others.  The builders[]
+		 * array can't change any more, since nobody registers once the build
+		 * is done.
+		 */
+		if (last)
+		{
+			for (i = 0; i < shared->nbuilders; i++)
+			{
+				if (shared->builders[i] != MyProc->pgprocno)
+					SetLatch(&ProcGlobal->allProcs[shared->builders[i]].procLatch);
+			}
+		}
+	}
+
+	/* Wait for the build to complete */
+	for (;;)
+	{
+		bool		done;
+
+		SpinLockAcquire(&shared->mutex);
+		done = shared->build_done;
+		hashtable->totalTuples = shared->totalTuples;
+		hashtable->spaceUsed = shared->arena_used +
+			shared->nbuckets * sizeof(pg_atomic_uint32);
+		SpinLockRelease(&shared->mutex);
+
+		if (done)
+			break;
+
+		pgstat_report_wait_start(WAIT_EVENT_HASH_BUILD_WORKERS);
+		WaitLatch(MyLatch, WL_LATCH_SET, 0);
+		pgstat_report_wait_end();
+		ResetLatch(MyLatch);
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	/* Report the space used by the whole table (in EXPLAIN ANALYZE) */
+	hashtable->spacePeak = hashtable->spaceUsed;
+}
+
+/*
+ * ExecHashTableInsertShared
+ *		insert a tuple into a hash table in shared memory
+ *
+ * Returns false, without inserting the tuple, if the table is full.
+ */
+static bool
+ExecHashTableInsertShared(HashJoinTable hashtable,
+						  TupleTableSlot *slot,
+						  uint32 hashvalue)
+{
+	MinimalTuple tuple = ExecFetchSlotMinimalTuple(slot);
+	SharedHashJoinTable shared = hashtable->shared;
+	pg_atomic_uint32 *buckets = SharedHashJoinBuckets(shared);
+	SharedHashJoinTuple hashTuple;
+	int			hashTupleSize;
+	int			bucketno;
+	uint32		offset;
+	uint32		head;
+
+	/* Create the SharedHashJoinTuple */
+	hashTupleSize = SHJTUPLE_OVERHEAD + tuple->t_len;
+	hashTuple = (SharedHashJoinTuple) shared_dense_alloc(hashtable,
+														 hashTupleSize);
+	if (hashTuple == NULL)
+		return false;
+
+	hashTuple->hashvalue = hashvalue;
+	memcpy(SHJTUPLE_MINTUPLE(hashTuple), tuple, tuple->t_len);
+	HeapTupleHeaderClearMatch(SHJTUPLE_MINTUPLE(hashTuple));
+
+	/*
+	 * Push it onto the front of the bucket's list.  Other participants may
+	 * be doing the same thing concurrently, so we must retry if the head of
+	 * the list changes under us.  The compare-and-swap is a full barrier, so
+	 * the tuple's contents are visible to anyone who can see the new head.
+	 */
+	offset = (uint32) (((char *) hashTuple - SharedHashJoinArena(shared)) /
+					   MAXIMUM_ALIGNOF);
+	bucketno = hashvalue & (hashtable->nbuckets - 1);
+	head = pg_atomic_read_u32(&buckets[bucketno]);
+	do
+	{
+		hashTuple->next = head;
+	} while (!pg_atomic_compare_exchange_u32(&buckets[bucketno],
+											 &head, offset));
+
+	return true;
+}
+
+/*
+ * Allocate 'size' bytes of a shared hash table's arena.  Like dense_alloc,
+ * we carve small tuples out of larger chunks, to keep contention for the
+ * spinlock down.  Returns NULL if the arena is exhausted.
+ */
+static void *
+shared_dense_alloc(HashJoinTable hashtable, Size size)
+{
+	char	   *ptr;
+
+	/* just in case the size is not already aligned properly */
+	size = MAXALIGN(size);
+
+	/* Large tuples get space of their own */
+	if (size > HASH_CHUNK_THRESHOLD)
+		return shared_arena_alloc(hashtable->shared, size);
+
+	/* Get a fresh chunk if there's not enough space left in ours */
+	if (hashtable->sharedChunkFree < size)
+	{
+		ptr = shared_arena_alloc(hashtable->shared, HASH_CHUNK_SIZE);
+		if (ptr == NULL)
+			return NULL;
+		hashtable->sharedChunk = ptr;
+		hashtable->sharedChunkFree = HASH_CHUNK_SIZE;
+	}
+
+	ptr = hashtable->sharedChunk;
+	hashtable->sharedChunk += size;
+	hashtable->sharedChunkFree -= size;
+
+	return ptr;
+}
+
+/*
+ * Hand out 'size' bytes (a multiple of MAXIMUM_ALIGNOF) of the arena, or set
+ * the overflow flag and return NULL if there isn't room.  Once anybody has
+ * overflowed the table, there's no point in anyone continuing to fill it.
+ */
+static void *
+shared_arena_alloc(SharedHashJoinTable shared, Size size)
+{
+	char	   *ptr = NULL;
+
+	SpinLockAcquire(&shared->mutex);
+	if (!shared->overflow && size <= shared->arena_size - shared->arena_used)
+	{
+		ptr = SharedHashJoinArena(shared) + shared->arena_used;
+		shared->arena_used += size;
+	}
+	else
+		shared->overflow = true;
+	SpinLockRelease(&shared->mutex);
+
+	return ptr;
+}
+
+/*
+ * ExecHashSharedTableLayout
+ *		compute the size of a shared hash table for nparticipants processes
+ *
+ * If 'shared' isn't NULL, also fill in its layout fields.
+ */
+static Size
+ExecHashSharedTableLayout(HashState *node, int nparticipants,
+						  SharedHashJoinTable shared)
+{
+	Hash	   *plan = (Hash *) node->ps.plan;
+	int			nbuckets;
+	Size		arena_size;
+	Size		buckets_offset;
+	Size		arena_offset;
+
+	(void) ExecChooseSharedHashTableSize(plan->rows_total,
+										 plan->plan.plan_width,
+										 nparticipants,
+										 &nbuckets, &arena_size);
+
+	buckets_offset = MAXALIGN(add_size(offsetof(SharedHashJoinTableData,
+												builders),
+									   mul_size(nparticipants,
+												sizeof(int))));
+	arena_offset = MAXALIGN(add_size(buckets_offset,
+									 mul_size(nbuckets,
+											  sizeof(pg_atomic_uint32))));
+
+	if (shared != NULL)
+	{
+		shared->nbuckets = nbuckets;
+		shared->log2_nbuckets = my_log2(nbuckets);
+		shared->buckets_offset = buckets_offset;
+		shared->arena_offset = arena_offset;
+		shared->arena_size = arena_size;
+		shared->maxparticipants = nparticipants;
+	}
+
+	return add_size(arena_offset, arena_size);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecHashEstimate
+ *
+ *		estimates the space required for a shared hash table.
+ * ----------------------------------------------------------------
+ */
+void
+ExecHashEstimate(HashState *node, ParallelContext *pcxt)
+{
+	shm_toc_estimate_chunk(&pcxt->estimator,
+						   ExecHashSharedTableLayout(node,
+													 pcxt->nworkers + 1,
+													 NULL));
+	shm_toc_estimate_keys(&pcxt->estimator, 1);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecHashInitializeDSM
+ *
+ *		Set up an empty shared hash table.
+ * ----------------------------------------------------------------
+ */
+void
+ExecHashInitializeDSM(HashState *node, ParallelContext *pcxt)
+{
+	SharedHashJoinTable shared;
+	pg_atomic_uint32 *buckets;
+	Size		size;
+	int			i;
+
+	size = ExecHashSharedTableLayout(node, pcxt->nworkers + 1, NULL);
+	shared = shm_toc_allocate(pcxt->toc, size);
+
+	(void) ExecHashSharedTableLayout(node, pcxt->nworkers + 1, shared);
+	SpinLockInit(&shared->mutex);
+	shared->arena_used = MAXIMUM_ALIGNOF;	/* offset 0 means "no tuple" */
+	shared->totalTuples = 0;
+	shared->build_done = false;
+	shared->overflow = false;
+	shared->nbuilding = 0;
+	shared->nbuilders = 0;
+
+	buckets = SharedHashJoinBuckets(shared);
+	for (i = 0; i < shared->nbuckets; i++)
+		pg_atomic_init_u32(&buckets[i], 0);
+
+	shm_toc_insert(pcxt->toc, node->ps.plan->plan_node_id, shared);
+
+	/* The leader participates in building the table, too. */
+	node->shared_table = shared;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecHashInitializeWorker
+ *
+ *		Attach to the shared hash table set up by the leader.
+ * ----------------------------------------------------------------
+ */
+void
+ExecHashInitializeWorker(HashState *node, shm_toc *toc)
+{
+	SharedHashJoinTable shared;
+
+	shared = shm_toc_lookup(toc, node->ps.plan->plan_node_id);
+	if (shared == NULL)
+		elog(ERROR, "could not find shared hash table for plan node %d",
+			 node->ps.plan->plan_node_id);
+	node->shared_table = shared;
+}
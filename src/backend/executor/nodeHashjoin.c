@@ -20,7 +20,11 @@
 #include "executor/hashjoin.h"
 #include "executor/nodeHash.h"
 #include "executor/nodeHashjoin.h"
+#include "lib/bloomfilter.h"
 #include "miscadmin.h"
+#include "nodes/nodeFuncs.h"
+#include "optimizer/clauses.h"
+#include "parser/parsetree.h"
 #include "utils/memutils.h"
 
 
@@ -39,6 +43,24 @@
 /* Returns true if doing null-fill on inner relation */
 #define HJ_FILL_INNER(hjstate)	((hjstate)->hj_NullOuterTupleSlot != NULL)
 
+/*
+ * A pushed-down Bloom filter is given up on if, after this many outer
+ * tuples, it hasn't removed at least this fraction of them.  It's also not
+ * used at all if more than half of its bits ended up set.
+ */
+#define JOIN_FILTER_TRIAL_TUPLES	1000
+#define JOIN_FILTER_MIN_REMOVED		0.1
+#define JOIN_FILTER_MAX_BITS_SET	0.5
+
+/* GUC parameter */
+bool		enable_hashjoin_filter = true;
+
+typedef struct
+{
+	List	   *outer_tlist;	/* targetlist of the outer scan */
+	bool		failed;			/* found something we can't translate */
+} join_filter_key_context;
+
 static TupleTableSlot *ExecHashJoinOuterGetTuple(PlanState *outerNode,
 						  HashJoinState *hjstate,
 						  uint32 *hashvalue);
@@ -47,6 +69,11 @@ static TupleTableSlot *ExecHashJoinGetSavedTuple(HashJoinState *hjstate,
 						  uint32 *hashvalue,
 						  TupleTableSlot *tupleSlot);
 static bool ExecHashJoinNewBatch(HashJoinState *hjstate);
+static JoinFilterState *ExecHashJoinInitFilter(HashJoinState *hjstate,
+					   HashJoin *node);
+static Node *join_filter_key_mutator(Node *node,
+						join_filter_key_context *context);
+static void ExecHashJoinActivateFilter(HashJoinState *hjstate);
 
 
 /* ----------------------------------------------------------------
@@ -166,10 +193,13 @@ ExecHashJoin(HashJoinState *node)
 				/*
 				 * create the hash table
 				 */
-				hashtable = ExecHashTableCreate((Hash *) hashNode->ps.plan,
+				hashtable = ExecHashTableCreate(hashNode,
 												node->hj_HashOperators,
 												HJ_FILL_INNER(node));
 				node->hj_HashTable = hashtable;
+				if (node->hj_JoinFilter && hashtable->shared == NULL)
+					ExecHashTableCreateBloomFilter(hashtable,
+												hashNode->ps.plan->plan_rows);
 
 				/*
 				 * execute the Hash node, to build the hash table
@@ -177,6 +207,33 @@ ExecHashJoin(HashJoinState *node)
 				hashNode->hashtable = hashtable;
 				(void) MultiExecProcNode((PlanState *) hashNode);
 
+				/*
+				 * If a shared hash table turned out too small to hold the
+				 * whole inner relation, forget about it and build a private
+				 * one instead.  Rescanning the inner plan makes any parallel
+				 * scans in it start over serially, so we'll see all of it.
+				 */
+				if (hashtable->shared != NULL && hashtable->shared->overflow)
+				{
+					ExecHashTableDestroy(hashtable);
+					hashNode->shared_table = NULL;
+					ExecReScan((PlanState *) hashNode);
+
+					hashtable = ExecHashTableCreate(hashNode,
+													node->hj_HashOperators,
+													HJ_FILL_INNER(node));
+					node->hj_HashTable = hashtable;
+					if (node->hj_JoinFilter)
+						ExecHashTableCreateBloomFilter(hashtable,
+												hashNode->ps.plan->plan_rows);
+					hashNode->hashtable = hashtable;
+					(void) MultiExecProcNode((PlanState *) hashNode);
+				}
+
+				/* let the outer scan start testing the Bloom filter */
+				if (node->hj_JoinFilter)
+					ExecHashJoinActivateFilter(node);
+
 				/*
 				 * If the inner relation is completely empty, and we're not
 				 * doing a left outer join, we can quit without scanning the
@@ -237,6 +294,7 @@ ExecHashJoin(HashJoinState *node)
 				node->hj_CurSkewBucketNo = ExecHashGetSkewBucket(hashtable,
 																 hashvalue);
 				node->hj_CurTuple = NULL;
+				node->hj_CurSharedTuple = NULL;
 
 				/*
 				 * The tuple might not belong to the current batch (where
@@ -296,7 +354,13 @@ ExecHashJoin(HashJoinState *node)
 				if (joinqual == NIL || ExecQual(joinqual, econtext, false))
 				{
 					node->hj_MatchedOuter = true;
-					HeapTupleHeaderSetMatch(HJTUPLE_MINTUPLE(node->hj_CurTuple));
+
+					/*
+					 * Match flags are needed only for right and full joins,
+					 * which never use a shared hash table.
+					 */
+					if (hashtable->shared == NULL)
+						HeapTupleHeaderSetMatch(HJTUPLE_MINTUPLE(node->hj_CurTuple));
 
 					/* In an antijoin, we never return a matched tuple */
 					if (node->js.jointype == JOIN_ANTI)
@@ -433,6 +497,24 @@ ExecHashJoin(HashJoinState *node)
  */
 HashJoinState *
 ExecInitHashJoin(HashJoin *node, EState *estate, int eflags)
+{
+	return ExecInitHashJoinOverStates(node, estate, eflags, NULL, NULL);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecInitHashJoinOverStates
+ *
+ *		Like ExecInitHashJoin, but if outerState and innerState aren't
+ *		NULL, use them as the already initialized states of our outer plan
+ *		and of the child of our Hash node, instead of initializing those.
+ *		This lets a nestloop switch to a hash join over its own children.
+ *		Such a node must not be passed to ExecEndNode, since the children
+ *		belong to the caller; see ExecEndNestLoop.
+ * ----------------------------------------------------------------
+ */
+HashJoinState *
+ExecInitHashJoinOverStates(HashJoin *node, EState *estate, int eflags,
+						   PlanState *outerState, PlanState *innerState)
 {
 	HashJoinState *hjstate;
 	Plan	   *outerNode;
@@ -486,8 +568,19 @@ ExecInitHashJoin(HashJoin *node, EState *estate, int eflags)
 	outerNode = outerPlan(node);
 	hashNode = (Hash *) innerPlan(node);
 
-	outerPlanState(hjstate) = ExecInitNode(outerNode, estate, eflags);
-	innerPlanState(hjstate) = ExecInitNode((Plan *) hashNode, estate, eflags);
+	if (outerState != NULL)
+	{
+		Assert(innerState != NULL);
+		outerPlanState(hjstate) = outerState;
+		innerPlanState(hjstate) = (PlanState *)
+			ExecInitHashOverState(hashNode, estate, eflags, innerState);
+	}
+	else
+	{
+		outerPlanState(hjstate) = ExecInitNode(outerNode, estate, eflags);
+		innerPlanState(hjstate) = ExecInitNode((Plan *) hashNode, estate,
+											   eflags);
+	}
 
 	/*
 	 * tuple table initialization
@@ -558,6 +651,7 @@ ExecInitHashJoin(HashJoin *node, EState *estate, int eflags)
 	hjstate->hj_CurBucketNo = 0;
 	hjstate->hj_CurSkewBucketNo = INVALID_SKEW_BUCKET_NO;
 	hjstate->hj_CurTuple = NULL;
+	hjstate->hj_CurSharedTuple = NULL;
 
 	/*
 	 * Deconstruct the hash clauses into outer and inner argument values, so
@@ -586,6 +680,8 @@ ExecInitHashJoin(HashJoin *node, EState *estate, int eflags)
 	/* child Hash node needs to evaluate inner hash keys, too */
 	((HashState *) innerPlanState(hjstate))->hashkeys = rclauses;
 
+	hjstate->hj_JoinFilter = ExecHashJoinInitFilter(hjstate, node);
+
 	hjstate->js.ps.ps_TupFromTlist = false;
 	hjstate->hj_JoinState = HJ_BUILD_HASHTABLE;
 	hjstate->hj_MatchedOuter = false;
@@ -603,9 +699,30 @@ ExecInitHashJoin(HashJoin *node, EState *estate, int eflags)
 void
 ExecEndHashJoin(HashJoinState *node)
 {
+	ExecEndHashJoinOverStates(node);
+
 	/*
-	 * Free hash table
+	 * clean up subtrees
 	 */
+	ExecEndNode(outerPlanState(node));
+	ExecEndNode(innerPlanState(node));
+}
+
+/* ----------------------------------------------------------------
+ *		ExecEndHashJoinOverStates
+ *
+ *		Shut down a hash join made by ExecInitHashJoinOverStates, leaving
+ *		the child plan states alone.
+ * ----------------------------------------------------------------
+ */
+void
+ExecEndHashJoinOverStates(HashJoinState *node)
+{
+	/*
+	 * Free hash table, making sure the outer scan doesn't test its filter
+	 */
+	if (node->hj_JoinFilter)
+		node->hj_JoinFilter->hashtable = NULL;
 	if (node->hj_HashTable)
 	{
 		ExecHashTableDestroy(node->hj_HashTable);
@@ -623,12 +740,6 @@ ExecEndHashJoin(HashJoinState *node)
 	ExecClearTuple(node->js.ps.ps_ResultTupleSlot);
 	ExecClearTuple(node->hj_OuterTupleSlot);
 	ExecClearTuple(node->hj_HashTupleSlot);
-
-	/*
-	 * clean up subtrees
-	 */
-	ExecEndNode(outerPlanState(node));
-	ExecEndNode(innerPlanState(node));
 }
 
 /*
@@ -877,7 +988,7 @@ ExecHashJoinSaveTuple(MinimalTuple tuple, uint32 hashvalue,
 	if (file == NULL)
 	{
 		/* First write to this batch file, so open it. */
-		file = BufFileCreateTemp(false);
+		file = BufFileCreateTempExtended(false, BUFFILE_COMPRESS);
 		*fileptr = file;
 	}
 
@@ -949,10 +1060,20 @@ ExecReScanHashJoin(HashJoinState *node)
 	 * if it's a single-batch join, and there is no parameter change for the
 	 * inner subnode, then we can just re-use the existing hash table without
 	 * rebuilding it.
+	 *
+	 * A shared hash table is never reused.  We only get rescanned in that
+	 * case when the Gather node above us is rescanned, in which case it has
+	 * already destroyed the shared memory in which the table lived (and will
+	 * give our Hash node a fresh one if it runs in parallel again), or when
+	 * a shared hash join above us is falling back to a private hash table,
+	 * in which case we had better read all of our inner relation too.
 	 */
+	((HashState *) innerPlanState(node))->shared_table = NULL;
+
 	if (node->hj_HashTable != NULL)
 	{
 		if (node->hj_HashTable->nbatch == 1 &&
+			node->hj_HashTable->shared == NULL &&
 			node->js.ps.righttree->chgParam == NULL)
 		{
 			/*
@@ -980,7 +1101,9 @@ ExecReScanHashJoin(HashJoinState *node)
 		}
 		else
 		{
-			/* must destroy and rebuild hash table */
+			/* must destroy and rebuild hash table, and its filter */
+			if (node->hj_JoinFilter)
+				node->hj_JoinFilter->hashtable = NULL;
 			ExecHashTableDestroy(node->hj_HashTable);
 			node->hj_HashTable = NULL;
 			node->hj_JoinState = HJ_BUILD_HASHTABLE;
@@ -999,6 +1122,7 @@ ExecReScanHashJoin(HashJoinState *node)
 	node->hj_CurBucketNo = 0;
 	node->hj_CurSkewBucketNo = INVALID_SKEW_BUCKET_NO;
 	node->hj_CurTuple = NULL;
+	node->hj_CurSharedTuple = NULL;
 
 	node->js.ps.ps_TupFromTlist = false;
 	node->hj_MatchedOuter = false;
@@ -1011,3 +1135,176 @@ ExecReScanHashJoin(HashJoinState *node)
 	if (node->js.ps.lefttree->chgParam == NULL)
 		ExecReScan(node->js.ps.lefttree);
 }
+
+/*
+ * ExecHashJoinInitFilter
+ *		Set up pushing a Bloom filter of the inner hash values down to the
+ *		outer scan, if that's possible here.
+ *
+ * The outer tuples the filter rejects are just dropped, so we can only do
+ * this for join types that don't emit unmatched outer tuples.  The outer
+ * side must be a scan node that uses ExecScan, and the outer hash keys must
+ * be computable from its scan tuple.  They refer to the scan's output
+ * columns, so we translate them to refer to the underlying columns of the
+ * scan instead, which lets the scan test a tuple before projecting it.
+ *
+ * Rejected tuples skip the scan's qual and targetlist altogether, so if
+ * either contains volatile functions, we don't filter: the functions must
+ * still be called for every tuple, as they would be without the filter.
+ */
+static JoinFilterState *
+ExecHashJoinInitFilter(HashJoinState *hjstate, HashJoin *node)
+{
+	PlanState  *outerState = outerPlanState(hjstate);
+	join_filter_key_context context;
+	JoinFilterState *jfstate;
+	List	   *hashkeys = NIL;
+	ListCell   *l;
+
+	if (!enable_hashjoin_filter)
+		return NULL;
+
+	switch (node->join.jointype)
+	{
+		case JOIN_INNER:
+		case JOIN_SEMI:
+		case JOIN_RIGHT:
+			break;
+		default:
+			return NULL;
+	}
+
+	if (!IsA(outerState, SeqScanState) &&
+		!IsA(outerState, BitmapHeapScanState) &&
+		!IsA(outerState, ForeignScanState))
+		return NULL;
+
+	if (contain_volatile_functions((Node *) outerState->plan->qual) ||
+		contain_volatile_functions((Node *) outerState->plan->targetlist))
+		return NULL;
+
+	context.outer_tlist = outerState->plan->targetlist;
+	context.failed = false;
+
+	foreach(l, node->hashclauses)
+	{
+		OpExpr	   *hclause = (OpExpr *) lfirst(l);
+		Node	   *key;
+
+		Assert(IsA(hclause, OpExpr));
+		key = join_filter_key_mutator((Node *) linitial(hclause->args),
+									  &context);
+		if (context.failed)
+			return NULL;
+		hashkeys = lappend(hashkeys, key);
+	}
+
+	jfstate = (JoinFilterState *) palloc0(sizeof(JoinFilterState));
+	jfstate->hashkeys = (List *) ExecInitExpr((Expr *) hashkeys, outerState);
+	jfstate->econtext = CreateExprContext(hjstate->js.ps.state);
+
+	((ScanState *) outerState)->ss_JoinFilter = jfstate;
+
+	return jfstate;
+}
+
+/*
+ * Replace references to the outer scan's output columns with the
+ * expressions that compute them, as long as those are plain column
+ * references.  Anything else is rejected, which is rare enough for the
+ * sort of join keys a Bloom filter would help with.
+ */
+static Node *
+join_filter_key_mutator(Node *node, join_filter_key_context *context)
+{
+	if (node == NULL)
+		return NULL;
+	if (IsA(node, Var))
+	{
+		Var		   *var = (Var *) node;
+		TargetEntry *tle;
+
+		if (var->varno != OUTER_VAR)
+		{
+			context->failed = true;
+			return node;
+		}
+		tle = get_tle_by_resno(context->outer_tlist, var->varattno);
+		if (tle == NULL || !IsA(tle->expr, Var) ||
+			((Var *) tle->expr)->varattno == 0)
+		{
+			context->failed = true;
+			return node;
+		}
+		return (Node *) copyObject(tle->expr);
+	}
+	if (IsA(node, SubPlan) ||
+		IsA(node, AlternativeSubPlan))
+	{
+		context->failed = true;
+		return node;
+	}
+	return expression_tree_mutator(node, join_filter_key_mutator,
+								   (void *) context);
+}
+
+/*
+ * ExecHashJoinActivateFilter
+ *		Make the outer scan start testing the filter of the hash table just
+ *		built, unless it doesn't look selective enough to bother.
+ */
+static void
+ExecHashJoinActivateFilter(HashJoinState *hjstate)
+{
+	JoinFilterState *jfstate = hjstate->hj_JoinFilter;
+	HashJoinTable hashtable = hjstate->hj_HashTable;
+
+	jfstate->hashtable = NULL;
+	jfstate->ntested = 0;
+	jfstate->nremoved = 0;
+
+	if (hashtable->bloomfilter == NULL ||
+		bloom_prop_bits_set(hashtable->bloomfilter) > JOIN_FILTER_MAX_BITS_SET)
+		return;
+
+	jfstate->hashtable = hashtable;
+}
+
+/*
+ * ExecHashJoinFilterTuple
+ *		Test a scan tuple against the Bloom filter pushed down to the scan.
+ *
+ * Returns false if the tuple certainly has no join partner, so that the scan
+ * can discard it.  The caller must have checked that the filter is active,
+ * that is that jfstate->hashtable isn't NULL.
+ */
+bool
+ExecHashJoinFilterTuple(JoinFilterState *jfstate, TupleTableSlot *slot)
+{
+	ExprContext *econtext = jfstate->econtext;
+	uint32		hashvalue;
+	bool		result;
+
+	econtext->ecxt_scantuple = slot;
+
+	result = (ExecHashGetHashValue(jfstate->hashtable, econtext,
+								   jfstate->hashkeys,
+								   true,		/* outer tuple */
+								   false,		/* null keys can't match */
+								   &hashvalue) &&
+			  !bloom_lacks_hash(jfstate->hashtable->bloomfilter, hashvalue));
+
+	jfstate->ntested += 1;
+	if (!result)
+	{
+		jfstate->nremoved += 1;
+		jfstate->nremoved_total += 1;
+	}
+
+	/* Stop testing if it turns out not to pay off */
+	if (jfstate->ntested == JOIN_FILTER_TRIAL_TUPLES &&
+		jfstate->nremoved < JOIN_FILTER_TRIAL_TUPLES * JOIN_FILTER_MIN_REMOVED)
+		jfstate->hashtable = NULL;
+
+	return result;
+}
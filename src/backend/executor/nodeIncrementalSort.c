@@ -0,0 +1,347 @@
+/*-------------------------------------------------------------------------
+ *
+ * nodeIncrementalSort.c
+ *	  Routines to handle sorting of relations that are already sorted on
+ *	  a prefix of the sort keys.
+ *
+ * When the input of a sort is known to be ordered by the first few sort
+ * keys already, as when it comes from an index scan on those columns, it is
+ * enough to sort each group of tuples with equal values in those columns.
+ * That needs only enough memory for one group at a time, and the first
+ * tuples can be returned as soon as the first group has been read, which
+ * matters a lot under a LIMIT.
+ *
+ * Sorting one tuplesort per group would be expensive if the groups are
+ * small, so the input is actually read in batches: a batch takes at least
+ * INCSORT_MIN_BATCH tuples, and then continues for as long as the tuples
+ * match the presorted columns of the last of those.  A batch thus always
+ * ends at a change in the presorted columns, and sorting it on all the sort
+ * keys puts it in its final order.
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ * IDENTIFICATION
+ *	  src/backend/executor/nodeIncrementalSort.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "executor/execdebug.h"
+#include "executor/executor.h"
+#include "executor/nodeIncrementalSort.h"
+#include "miscadmin.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/tuplesort.h"
+
+
+/* Minimum number of tuples sorted together */
+#define INCSORT_MIN_BATCH	32
+
+
+/*
+ * Release the tuplesort of the current batch, remembering its statistics
+ * for EXPLAIN ANALYZE if it's the largest so far.
+ */
+static void
+incsort_end_batch(IncrementalSortState *node)
+{
+	Tuplesortstate *tuplesortstate = (Tuplesortstate *) node->tuplesortstate;
+	const char *sortMethod;
+	const char *spaceType;
+	long		spaceUsed;
+
+	tuplesort_get_stats(tuplesortstate, &sortMethod, &spaceType, &spaceUsed);
+	if (node->maxSortMethod == NULL || spaceUsed > node->maxSpaceUsed)
+	{
+		node->maxSortMethod = sortMethod;
+		node->maxSpaceType = spaceType;
+		node->maxSpaceUsed = spaceUsed;
+	}
+
+	tuplesort_end(tuplesortstate);
+	node->tuplesortstate = NULL;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecIncrementalSort
+ *
+ *		Reads the next batch of tuples from the outer subtree when the
+ *		previous one has been returned, sorts it using tuplesort, and
+ *		returns tuples from it with each call.
+ *
+ *		Conditions:
+ *		  -- the outer subtree returns tuples ordered by the presorted
+ *			 columns.
+ *
+ *		Initial States:
+ *		  -- the outer child is prepared to return the first tuple.
+ * ----------------------------------------------------------------
+ */
+TupleTableSlot *
+ExecIncrementalSort(IncrementalSortState *node)
+{
+	IncrementalSort *plannode = (IncrementalSort *) node->ss.ps.plan;
+	PlanState  *outerNode = outerPlanState(node);
+	ExprContext *econtext = node->ss.ps.ps_ExprContext;
+	TupleTableSlot *resultSlot = node->ss.ps.ps_ResultTupleSlot;
+
+	Assert(ScanDirectionIsForward(node->ss.ps.state->es_direction));
+
+	for (;;)
+	{
+		Tuplesortstate *tuplesortstate;
+		TupleTableSlot *slot;
+		int64		ntuples;
+
+		/* Return the next tuple of the current batch, if any */
+		if (node->tuplesortstate != NULL)
+		{
+			if (tuplesort_gettupleslot((Tuplesortstate *) node->tuplesortstate,
+									   true, resultSlot))
+			{
+				node->tuplesReturned++;
+				return resultSlot;
+			}
+			incsort_end_batch(node);
+		}
+
+		if (node->outerDone)
+			return ExecClearTuple(resultSlot);
+
+		/*
+		 * Start a new batch.  If we're bounded, this batch needs to produce
+		 * only as many tuples as haven't been returned yet.
+		 */
+		SO1_printf("ExecIncrementalSort: %s\n", "reading next batch");
+
+		tuplesortstate = tuplesort_begin_heap(ExecGetResultType(outerNode),
+											  plannode->sort.numCols,
+											  plannode->sort.sortColIdx,
+											  plannode->sort.sortOperators,
+											  plannode->sort.collations,
+											  plannode->sort.nullsFirst,
+											  work_mem,
+											  false);
+		if (node->bounded)
+			tuplesort_set_bound(tuplesortstate,
+								Max(node->bound - node->tuplesReturned, 1));
+		node->tuplesortstate = (void *) tuplesortstate;
+		ExecClearTuple(node->pivotSlot);
+		ntuples = 0;
+
+		/* The tuple that ended the last batch begins this one */
+		if (!TupIsNull(node->transferSlot))
+		{
+			tuplesort_puttupleslot(tuplesortstate, node->transferSlot);
+			if (++ntuples == INCSORT_MIN_BATCH)
+				ExecCopySlot(node->pivotSlot, node->transferSlot);
+			ExecClearTuple(node->transferSlot);
+		}
+
+		for (;;)
+		{
+			slot = ExecProcNode(outerNode);
+			if (TupIsNull(slot))
+			{
+				node->outerDone = true;
+				break;
+			}
+
+			/*
+			 * Once the batch is big enough, stop at the first tuple that
+			 * differs from the pivot in the presorted columns.
+			 */
+			if (!TupIsNull(node->pivotSlot))
+			{
+				bool		match;
+
+				ResetExprContext(econtext);
+				match = execTuplesMatch(slot, node->pivotSlot,
+										plannode->presortedCols,
+										plannode->sort.sortColIdx,
+										node->eqfunctions,
+										econtext->ecxt_per_tuple_memory);
+				if (!match)
+				{
+					ExecCopySlot(node->transferSlot, slot);
+					break;
+				}
+			}
+
+			tuplesort_puttupleslot(tuplesortstate, slot);
+			if (++ntuples == INCSORT_MIN_BATCH)
+				ExecCopySlot(node->pivotSlot, slot);
+		}
+
+		tuplesort_performsort(tuplesortstate);
+		node->batchesSorted++;
+	}
+}
+
+/* ----------------------------------------------------------------
+ *		ExecInitIncrementalSort
+ *
+ *		Creates the run-time state information for the incremental sort
+ *		node produced by the planner and initializes its outer subtree.
+ * ----------------------------------------------------------------
+ */
+IncrementalSortState *
+ExecInitIncrementalSort(IncrementalSort *node, EState *estate, int eflags)
+{
+	IncrementalSortState *sortstate;
+	Oid		   *eqOperators;
+	int			i;
+
+	SO1_printf("ExecInitIncrementalSort: %s\n",
+			   "initializing sort node");
+
+	/*
+	 * check for unsupported flags.  Since each batch is discarded once it
+	 * has been returned, we can support neither backward scan nor
+	 * mark/restore.
+	 */
+	Assert(!(eflags & (EXEC_FLAG_BACKWARD | EXEC_FLAG_MARK)));
+
+	/*
+	 * create state structure
+	 */
+	sortstate = makeNode(IncrementalSortState);
+	sortstate->ss.ps.plan = (Plan *) node;
+	sortstate->ss.ps.state = estate;
+
+	sortstate->bounded = false;
+	sortstate->outerDone = false;
+	sortstate->tuplesReturned = 0;
+	sortstate->tuplesortstate = NULL;
+	sortstate->batchesSorted = 0;
+	sortstate->maxSortMethod = NULL;
+	sortstate->maxSpaceType = NULL;
+	sortstate->maxSpaceUsed = 0;
+
+	/*
+	 * Miscellaneous initialization
+	 *
+	 * We need an ExprContext only for the per-tuple memory used in comparing
+	 * the presorted columns.
+	 */
+	ExecAssignExprContext(estate, &sortstate->ss.ps);
+
+	/*
+	 * tuple table initialization
+	 */
+	ExecInitResultTupleSlot(estate, &sortstate->ss.ps);
+	ExecInitScanTupleSlot(estate, &sortstate->ss);
+	sortstate->pivotSlot = ExecInitExtraTupleSlot(estate);
+	sortstate->transferSlot = ExecInitExtraTupleSlot(estate);
+
+	/*
+	 * initialize child nodes
+	 *
+	 * We shield the child node from the need to support REWIND.
+	 */
+	eflags &= ~EXEC_FLAG_REWIND;
+
+	outerPlanState(sortstate) = ExecInitNode(outerPlan(node), estate, eflags);
+
+	/*
+	 * initialize tuple type.  no need to initialize projection info because
+	 * this node doesn't do projections.
+	 */
+	ExecAssignResultTypeFromTL(&sortstate->ss.ps);
+	ExecAssignScanTypeFromOuterPlan(&sortstate->ss);
+	sortstate->ss.ps.ps_ProjInfo = NULL;
+
+	ExecSetSlotDescriptor(sortstate->pivotSlot,
+						  ExecGetResultType(outerPlanState(sortstate)));
+	ExecSetSlotDescriptor(sortstate->transferSlot,
+						  ExecGetResultType(outerPlanState(sortstate)));
+
+	/*
+	 * Precompute fmgr lookup data for comparing the presorted columns
+	 */
+	eqOperators = (Oid *) palloc(node->presortedCols * sizeof(Oid));
+	for (i = 0; i < node->presortedCols; i++)
+	{
+		eqOperators[i] = get_equality_op_for_ordering_op(node->sort.sortOperators[i],
+														 NULL);
+		if (!OidIsValid(eqOperators[i]))
+			elog(ERROR, "could not find equality operator for ordering operator %u",
+				 node->sort.sortOperators[i]);
+	}
+	sortstate->eqfunctions = execTuplesMatchPrepare(node->presortedCols,
+													eqOperators);
+	pfree(eqOperators);
+
+	SO1_printf("ExecInitIncrementalSort: %s\n",
+			   "sort node initialized");
+
+	return sortstate;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecEndIncrementalSort(node)
+ * ----------------------------------------------------------------
+ */
+void
+ExecEndIncrementalSort(IncrementalSortState *node)
+{
+	SO1_printf("ExecEndIncrementalSort: %s\n",
+			   "shutting down sort node");
+
+	/*
+	 * clean out the tuple table
+	 */
+	ExecClearTuple(node->ss.ss_ScanTupleSlot);
+	/* must drop pointer to sort result tuple */
+	ExecClearTuple(node->ss.ps.ps_ResultTupleSlot);
+	ExecClearTuple(node->pivotSlot);
+	ExecClearTuple(node->transferSlot);
+
+	/*
+	 * Release tuplesort resources
+	 */
+	if (node->tuplesortstate != NULL)
+		tuplesort_end((Tuplesortstate *) node->tuplesortstate);
+	node->tuplesortstate = NULL;
+
+	ExecFreeExprContext(&node->ss.ps);
+
+	/*
+	 * shut down the subplan
+	 */
+	ExecEndNode(outerPlanState(node));
+
+	SO1_printf("ExecEndIncrementalSort: %s\n",
+			   "sort node shutdown");
+}
+
+void
+ExecReScanIncrementalSort(IncrementalSortState *node)
+{
+	PlanState  *outerPlan = outerPlanState(node);
+
+	/*
+	 * We keep only the current batch, so we always have to re-read the
+	 * subplan.  Keep the statistics of the batches sorted so far, though,
+	 * since EXPLAIN ANALYZE reports on all executions of the node.
+	 */
+	ExecClearTuple(node->ss.ps.ps_ResultTupleSlot);
+	ExecClearTuple(node->pivotSlot);
+	ExecClearTuple(node->transferSlot);
+	if (node->tuplesortstate != NULL)
+		incsort_end_batch(node);
+	node->outerDone = false;
+	node->tuplesReturned = 0;
+
+	/*
+	 * if chgParam of subnode is not null then plan will be re-scanned by
+	 * first ExecProcNode.
+	 */
+	if (outerPlan->chgParam == NULL)
+		ExecReScan(outerPlan);
+}
@@ -21,9 +21,16 @@
  *		ExecEndIndexOnlyScan		releases all storage.
  *		ExecIndexOnlyMarkPos		marks scan position.
  *		ExecIndexOnlyRestrPos		restores scan position.
+ *		ExecIndexOnlyScanEstimate	estimates DSM space needed for
+ *						parallel index-only scan
+ *		ExecIndexOnlyScanInitializeDSM	initialize DSM for parallel
+ *						index-only scan
+ *		ExecIndexOnlyScanInitializeWorker attach to DSM info in parallel
+ *						worker
  */
 #include "postgres.h"
 
+#include "access/parallel.h"
 #include "access/relscan.h"
 #include "access/visibilitymap.h"
 #include "executor/execdebug.h"
@@ -38,6 +45,8 @@
 static TupleTableSlot *IndexOnlyNext(IndexOnlyScanState *node);
 static void StoreIndexTuple(TupleTableSlot *slot, IndexTuple itup,
 				TupleDesc itupdesc);
+static void ExecIndexOnlyScanBeginParallel(IndexOnlyScanState *node,
+							   ParallelIndexScanDesc piscan);
 
 
 /* ----------------------------------------------------------------
@@ -295,6 +304,22 @@ ExecReScanIndexOnlyScan(IndexOnlyScanState *node)
 	}
 	node->ioss_RuntimeKeysReady = true;
 
+	/*
+	 * The shared state of a parallel scan belongs to the Gather node above
+	 * us, which tears it down before rescanning us; so go on with a scan of
+	 * our own.
+	 */
+	if (node->ioss_ScanDesc->parallel_scan != NULL)
+	{
+		index_endscan(node->ioss_ScanDesc);
+		node->ioss_ScanDesc = index_beginscan(node->ss.ss_currentRelation,
+											  node->ioss_RelationDesc,
+											  node->ss.ps.state->es_snapshot,
+											  node->ioss_NumScanKeys,
+											  node->ioss_NumOrderByKeys);
+		node->ioss_ScanDesc->xs_want_itup = true;
+	}
+
 	/* reset index scan */
 	index_rescan(node->ioss_ScanDesc,
 				 node->ioss_ScanKeys, node->ioss_NumScanKeys,
@@ -475,11 +500,14 @@ ExecInitIndexOnlyScan(IndexOnlyScan *node, EState *estate, int eflags)
 	 *
 	 * If the parent table is one of the target relations of the query, then
 	 * InitPlan already opened and write-locked the index, so we can avoid
-	 * taking another lock here.  Otherwise we need a normal reader's lock.
+	 * taking another lock here.  Otherwise we need a normal reader's lock;
+	 * except in a parallel worker, which relies on the leader's lock, as in
+	 * ExecOpenScanRelation.
 	 */
 	relistarget = ExecRelationIsTargetRelation(estate, node->scan.scanrelid);
 	indexstate->ioss_RelationDesc = index_open(node->indexid,
-									 relistarget ? NoLock : AccessShareLock);
+						 (relistarget || IsParallelWorker()) ?
+						 NoLock : AccessShareLock);
 
 	/*
 	 * Initialize index-specific scan state
@@ -564,3 +592,94 @@ ExecInitIndexOnlyScan(IndexOnlyScan *node, EState *estate, int eflags)
 	 */
 	return indexstate;
 }
+
+/* ----------------------------------------------------------------
+ *						Parallel Scan Support
+ * ----------------------------------------------------------------
+ */
+
+/*
+ * Replace the node's scan descriptor with one for the given parallel scan.
+ */
+static void
+ExecIndexOnlyScanBeginParallel(IndexOnlyScanState *node,
+							   ParallelIndexScanDesc piscan)
+{
+	index_endscan(node->ioss_ScanDesc);
+	node->ioss_ScanDesc =
+		index_beginscan_parallel(node->ss.ss_currentRelation,
+								 node->ioss_RelationDesc,
+								 node->ioss_NumScanKeys,
+								 node->ioss_NumOrderByKeys,
+								 node->ss.ps.state->es_snapshot,
+								 piscan);
+	node->ioss_ScanDesc->xs_want_itup = true;
+
+	/*
+	 * If no run-time keys to calculate, or they've been calculated already,
+	 * go ahead and pass the scankeys to the index AM.
+	 */
+	if (node->ioss_NumRuntimeKeys == 0 || node->ioss_RuntimeKeysReady)
+		index_rescan(node->ioss_ScanDesc,
+					 node->ioss_ScanKeys, node->ioss_NumScanKeys,
+					 node->ioss_OrderByKeys, node->ioss_NumOrderByKeys);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecIndexOnlyScanEstimate
+ *
+ *		estimates the space required for the shared state of the
+ *		index AM.
+ * ----------------------------------------------------------------
+ */
+void
+ExecIndexOnlyScanEstimate(IndexOnlyScanState *node, ParallelContext *pcxt)
+{
+	shm_toc_estimate_chunk(&pcxt->estimator,
+						   index_parallelscan_estimate(node->ioss_RelationDesc,
+													   pcxt->nworkers + 1));
+	shm_toc_estimate_keys(&pcxt->estimator, 1);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecIndexOnlyScanInitializeDSM
+ *
+ *		Set up a parallel index scan descriptor.
+ * ----------------------------------------------------------------
+ */
+void
+ExecIndexOnlyScanInitializeDSM(IndexOnlyScanState *node,
+							   ParallelContext *pcxt)
+{
+	ParallelIndexScanDesc piscan;
+
+	piscan = shm_toc_allocate(pcxt->toc,
+						index_parallelscan_estimate(node->ioss_RelationDesc,
+													pcxt->nworkers + 1));
+	index_parallelscan_initialize(node->ss.ss_currentRelation,
+								  node->ioss_RelationDesc,
+								  piscan,
+								  pcxt->nworkers + 1);
+	shm_toc_insert(pcxt->toc, node->ss.ps.plan->plan_node_id, piscan);
+
+	/* The leader participates in the scan, too. */
+	ExecIndexOnlyScanBeginParallel(node, piscan);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecIndexOnlyScanInitializeWorker
+ *
+ *		Copy relevant information from TOC into planstate.
+ * ----------------------------------------------------------------
+ */
+void
+ExecIndexOnlyScanInitializeWorker(IndexOnlyScanState *node, shm_toc *toc)
+{
+	ParallelIndexScanDesc piscan;
+
+	piscan = shm_toc_lookup(toc, node->ss.ps.plan->plan_node_id);
+	if (piscan == NULL)
+		elog(ERROR, "could not find parallel scan state for plan node %d",
+			 node->ss.ps.plan->plan_node_id);
+	ExecIndexOnlyScanBeginParallel(node, piscan);
+}
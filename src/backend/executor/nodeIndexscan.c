@@ -22,10 +22,14 @@
  *		ExecEndIndexScan		releases all storage.
  *		ExecIndexMarkPos		marks scan position.
  *		ExecIndexRestrPos		restores scan position.
+ *		ExecIndexScanEstimate	estimates DSM space needed for parallel scan
+ *		ExecIndexScanInitializeDSM initialize DSM for parallel scan
+ *		ExecIndexScanInitializeWorker attach to DSM info in parallel worker
  */
 #include "postgres.h"
 
 #include "access/nbtree.h"
+#include "access/parallel.h"
 #include "access/relscan.h"
 #include "executor/execdebug.h"
 #include "executor/nodeIndexscan.h"
@@ -62,6 +66,8 @@ static int reorderqueue_cmp(const pairingheap_node *a,
 static void reorderqueue_push(IndexScanState *node, HeapTuple tuple,
 				  Datum *orderbyvals, bool *orderbynulls);
 static HeapTuple reorderqueue_pop(IndexScanState *node);
+static void ExecIndexScanBeginParallel(IndexScanState *node,
+						   ParallelIndexScanDesc piscan);
 
 
 /* ----------------------------------------------------------------
@@ -539,6 +545,21 @@ ExecReScanIndexScan(IndexScanState *node)
 			reorderqueue_pop(node);
 	}
 
+	/*
+	 * The shared state of a parallel scan belongs to the Gather node above
+	 * us, which tears it down before rescanning us; so go on with a scan of
+	 * our own.
+	 */
+	if (node->iss_ScanDesc->parallel_scan != NULL)
+	{
+		index_endscan(node->iss_ScanDesc);
+		node->iss_ScanDesc = index_beginscan(node->ss.ss_currentRelation,
+											 node->iss_RelationDesc,
+											 node->ss.ps.state->es_snapshot,
+											 node->iss_NumScanKeys,
+											 node->iss_NumOrderByKeys);
+	}
+
 	/* reset index scan */
 	index_rescan(node->iss_ScanDesc,
 				 node->iss_ScanKeys, node->iss_NumScanKeys,
@@ -899,11 +920,14 @@ ExecInitIndexScan(IndexScan *node, EState *estate, int eflags)
 	 *
 	 * If the parent table is one of the target relations of the query, then
 	 * InitPlan already opened and write-locked the index, so we can avoid
-	 * taking another lock here.  Otherwise we need a normal reader's lock.
+	 * taking another lock here.  Otherwise we need a normal reader's lock;
+	 * except in a parallel worker, which relies on the leader's lock, as in
+	 * ExecOpenScanRelation.
 	 */
 	relistarget = ExecRelationIsTargetRelation(estate, node->scan.scanrelid);
 	indexstate->iss_RelationDesc = index_open(node->indexid,
-									 relistarget ? NoLock : AccessShareLock);
+						 (relistarget || IsParallelWorker()) ?
+						 NoLock : AccessShareLock);
 
 	/*
 	 * Initialize index-specific scan state
@@ -1583,3 +1607,91 @@ ExecIndexBuildScanKeys(PlanState *planstate, Relation index,
 	else if (n_array_keys != 0)
 		elog(ERROR, "ScalarArrayOpExpr index qual found where not allowed");
 }
+
+/* ----------------------------------------------------------------
+ *						Parallel Scan Support
+ * ----------------------------------------------------------------
+ */
+
+/*
+ * Replace the node's scan descriptor with one for the given parallel scan.
+ */
+static void
+ExecIndexScanBeginParallel(IndexScanState *node, ParallelIndexScanDesc piscan)
+{
+	index_endscan(node->iss_ScanDesc);
+	node->iss_ScanDesc =
+		index_beginscan_parallel(node->ss.ss_currentRelation,
+								 node->iss_RelationDesc,
+								 node->iss_NumScanKeys,
+								 node->iss_NumOrderByKeys,
+								 node->ss.ps.state->es_snapshot,
+								 piscan);
+
+	/*
+	 * If no run-time keys to calculate, or they've been calculated already,
+	 * go ahead and pass the scankeys to the index AM.
+	 */
+	if (node->iss_NumRuntimeKeys == 0 || node->iss_RuntimeKeysReady)
+		index_rescan(node->iss_ScanDesc,
+					 node->iss_ScanKeys, node->iss_NumScanKeys,
+					 node->iss_OrderByKeys, node->iss_NumOrderByKeys);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecIndexScanEstimate
+ *
+ *		estimates the space required for the shared state of the
+ *		index AM.
+ * ----------------------------------------------------------------
+ */
+void
+ExecIndexScanEstimate(IndexScanState *node, ParallelContext *pcxt)
+{
+	shm_toc_estimate_chunk(&pcxt->estimator,
+						   index_parallelscan_estimate(node->iss_RelationDesc,
+													   pcxt->nworkers + 1));
+	shm_toc_estimate_keys(&pcxt->estimator, 1);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecIndexScanInitializeDSM
+ *
+ *		Set up a parallel index scan descriptor.
+ * ----------------------------------------------------------------
+ */
+void
+ExecIndexScanInitializeDSM(IndexScanState *node, ParallelContext *pcxt)
+{
+	ParallelIndexScanDesc piscan;
+
+	piscan = shm_toc_allocate(pcxt->toc,
+						index_parallelscan_estimate(node->iss_RelationDesc,
+													pcxt->nworkers + 1));
+	index_parallelscan_initialize(node->ss.ss_currentRelation,
+								  node->iss_RelationDesc,
+								  piscan,
+								  pcxt->nworkers + 1);
+	shm_toc_insert(pcxt->toc, node->ss.ps.plan->plan_node_id, piscan);
+
+	/* The leader participates in the scan, too. */
+	ExecIndexScanBeginParallel(node, piscan);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecIndexScanInitializeWorker
+ *
+ *		Copy relevant information from TOC into planstate.
+ * ----------------------------------------------------------------
+ */
+void
+ExecIndexScanInitializeWorker(IndexScanState *node, shm_toc *toc)
+{
+	ParallelIndexScanDesc piscan;
+
+	piscan = shm_toc_lookup(toc, node->ss.ps.plan->plan_node_id);
+	if (piscan == NULL)
+		elog(ERROR, "could not find parallel scan state for plan node %d",
+			 node->ss.ps.plan->plan_node_id);
+	ExecIndexScanBeginParallel(node, piscan);
+}
@@ -0,0 +1,526 @@
+/*-------------------------------------------------------------------------
+ *
+ * nodeMemoize.c
+ *	  Routines to cache the results of a parameterized subplan.
+ *
+ * A Memoize node sits on the inner side of a parameterized nestloop.  Each
+ * rescan comes with new parameter values; when the same values have been
+ * seen before, the tuples the subplan returned for them are read back from
+ * a hash table instead of running the subplan again.  This pays off when
+ * the outer side repeats a small set of join keys many times over, as it
+ * does when joining a large table to a small dimension table.
+ *
+ * The cache uses at most work_mem.  When it is full, the least recently
+ * used entries are evicted to make room.  If the results for a single set
+ * of parameter values don't fit at all, they are just passed through from
+ * the subplan without being cached.
+ *
+ * The cache key only covers the parameters the nestloop passes down.  If
+ * any other parameter the subplan depends on changes, as when we are part
+ * of a correlated subquery, the whole cache is thrown away.
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ * IDENTIFICATION
+ *	  src/backend/executor/nodeMemoize.c
+ *
+ *-------------------------------------------------------------------------
+ */
+/*
+ * INTERFACE ROUTINES
+ *		ExecMemoize			- return the next tuple for the current key
+ *		ExecInitMemoize		- initialize node and subnodes
+ *		ExecEndMemoize		- shutdown node and subnodes
+ *		ExecReScanMemoize	- prepare for the next set of parameter values
+ */
+#include "postgres.h"
+
+#include "executor/executor.h"
+#include "executor/nodeMemoize.h"
+#include "miscadmin.h"
+#include "nodes/nodeFuncs.h"
+#include "utils/memutils.h"
+
+
+/*
+ * States of the ExecMemoize state machine
+ */
+#define MEMO_CACHE_LOOKUP			1
+#define MEMO_CACHE_FETCH_NEXT_TUPLE 2
+#define MEMO_FILLING_CACHE			3
+#define MEMO_CACHE_BYPASS_MODE		4
+#define MEMO_END_OF_SCAN			5
+
+/* One cached tuple */
+typedef struct MemoizeTuple
+{
+	MinimalTuple mintuple;		/* the tuple itself */
+	struct MemoizeTuple *next;	/* next tuple for the same key, or NULL */
+} MemoizeTuple;
+
+/* Hash table entry for one set of parameter values */
+typedef struct MemoizeEntry
+{
+	TupleHashEntryData shared;	/* common header for hash table entries */
+	dlist_node	lru_node;		/* position in the LRU list */
+	MemoizeTuple *tuples;		/* cached tuples, in subplan order */
+	MemoizeTuple *last;			/* last of those */
+	Size		mem;			/* memory used by the entry and its tuples */
+	bool		complete;		/* do we have all the subplan's tuples? */
+} MemoizeEntry;
+
+
+/*
+ * Collect the PARAM_EXEC params used by the cache key expressions.
+ */
+static bool
+memoize_param_walker(Node *node, Bitmapset **paramids)
+{
+	if (node == NULL)
+		return false;
+	if (IsA(node, Param) &&
+		((Param *) node)->paramkind == PARAM_EXEC)
+		*paramids = bms_add_member(*paramids, ((Param *) node)->paramid);
+	return expression_tree_walker(node, memoize_param_walker,
+								  (void *) paramids);
+}
+
+/*
+ * (Re)create an empty cache.
+ */
+static void
+build_memoize_table(MemoizeState *node)
+{
+	Memoize    *plannode = (Memoize *) node->ss.ps.plan;
+
+	node->hashtable = BuildTupleHashTable(plannode->numKeys,
+										  node->keyColIdx,
+										  node->eqfunctions,
+										  node->hashfunctions,
+										  Max(plannode->est_entries, 1),
+										  sizeof(MemoizeEntry),
+										  node->tableContext,
+							   node->ss.ps.ps_ExprContext->ecxt_per_tuple_memory);
+	dlist_init(&node->lru_list);
+	node->mem_used = 0;
+	node->entry = NULL;
+	node->last_tuple = NULL;
+}
+
+/*
+ * Throw away the whole cache.
+ */
+static void
+memoize_purge(MemoizeState *node)
+{
+	MemoryContextReset(node->tableContext);
+	build_memoize_table(node);
+}
+
+/*
+ * Free the tuples cached for an entry, keeping the entry itself.
+ */
+static void
+memoize_remove_tuples(MemoizeState *node, MemoizeEntry *entry)
+{
+	MemoizeTuple *mtup = entry->tuples;
+
+	while (mtup != NULL)
+	{
+		MemoizeTuple *next = mtup->next;
+
+		entry->mem -= GetMemoryChunkSpace(mtup->mintuple) +
+			GetMemoryChunkSpace(mtup);
+		node->mem_used -= GetMemoryChunkSpace(mtup->mintuple) +
+			GetMemoryChunkSpace(mtup);
+		pfree(mtup->mintuple);
+		pfree(mtup);
+		mtup = next;
+	}
+	entry->tuples = NULL;
+	entry->last = NULL;
+	entry->complete = false;
+}
+
+/*
+ * Remove an entry from the cache altogether.
+ */
+static void
+memoize_remove_entry(MemoizeState *node, MemoizeEntry *entry)
+{
+	MinimalTuple key = entry->shared.firstTuple;
+
+	memoize_remove_tuples(node, entry);
+	dlist_delete(&entry->lru_node);
+	node->mem_used -= entry->mem;
+
+	/* The hash table finds the entry to remove by its key */
+	ExecStoreMinimalTuple(key, node->removeslot, false);
+	RemoveTupleHashEntry(node->hashtable, node->removeslot);
+	ExecClearTuple(node->removeslot);
+	pfree(key);
+}
+
+/*
+ * Evict least recently used entries other than 'keep' until the cache fits
+ * in its memory limit again.  Returns false if even 'keep' alone is too big.
+ */
+static bool
+memoize_evict(MemoizeState *node, MemoizeEntry *keep)
+{
+	while (node->mem_used > node->mem_limit)
+	{
+		MemoizeEntry *victim;
+
+		Assert(!dlist_is_empty(&node->lru_list));
+		victim = dlist_tail_element(MemoizeEntry, lru_node, &node->lru_list);
+		if (victim == keep)
+		{
+			/* keep is the most recently used entry, so it's the only one */
+			return false;
+		}
+		memoize_remove_entry(node, victim);
+		node->cache_evictions++;
+	}
+	return true;
+}
+
+/*
+ * Add a tuple to the entry being filled.  Returns false if the entry had
+ * to be given up because its tuples don't fit in the cache; it has been
+ * removed in that case.
+ */
+static bool
+memoize_store_tuple(MemoizeState *node, TupleTableSlot *slot)
+{
+	MemoizeEntry *entry = node->entry;
+	MemoryContext oldcontext;
+	MemoizeTuple *mtup;
+	Size		mem;
+
+	oldcontext = MemoryContextSwitchTo(node->tableContext);
+	mtup = (MemoizeTuple *) palloc(sizeof(MemoizeTuple));
+	mtup->mintuple = ExecCopySlotMinimalTuple(slot);
+	mtup->next = NULL;
+	MemoryContextSwitchTo(oldcontext);
+
+	if (entry->last != NULL)
+		entry->last->next = mtup;
+	else
+		entry->tuples = mtup;
+	entry->last = mtup;
+
+	mem = GetMemoryChunkSpace(mtup->mintuple) + GetMemoryChunkSpace(mtup);
+	entry->mem += mem;
+	node->mem_used += mem;
+
+	if (!memoize_evict(node, entry))
+	{
+		memoize_remove_entry(node, entry);
+		node->entry = NULL;
+		return false;
+	}
+	node->mem_peak = Max(node->mem_peak, node->mem_used);
+	return true;
+}
+
+/*
+ * Compute the cache key for the current parameter values into probeslot.
+ */
+static void
+memoize_prepare_probe(MemoizeState *node)
+{
+	ExprContext *econtext = node->ss.ps.ps_ExprContext;
+	TupleTableSlot *slot = node->probeslot;
+	ListCell   *lc;
+	int			i = 0;
+
+	ResetExprContext(econtext);
+	ExecClearTuple(slot);
+	foreach(lc, node->param_exprs)
+	{
+		ExprState  *keyexpr = (ExprState *) lfirst(lc);
+
+		slot->tts_values[i] = ExecEvalExpr(keyexpr, econtext,
+										   &slot->tts_isnull[i], NULL);
+		i++;
+	}
+	ExecStoreVirtualTuple(slot);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecMemoize
+ *
+ *		Returns the next tuple for the current parameter values, either
+ *		from the cache or from the subplan, caching it in the latter case.
+ * ----------------------------------------------------------------
+ */
+TupleTableSlot *
+ExecMemoize(MemoizeState *node)
+{
+	Memoize    *plannode = (Memoize *) node->ss.ps.plan;
+	PlanState  *outerNode = outerPlanState(node);
+	TupleTableSlot *slot;
+
+	switch (node->mstatus)
+	{
+		case MEMO_CACHE_LOOKUP:
+			{
+				MemoizeEntry *entry;
+				bool		isnew;
+
+				memoize_prepare_probe(node);
+				entry = (MemoizeEntry *)
+					LookupTupleHashEntry(node->hashtable, node->probeslot,
+										 &isnew);
+
+				if (!isnew && entry->complete)
+				{
+					node->cache_hits++;
+					dlist_move_head(&node->lru_list, &entry->lru_node);
+					node->entry = entry;
+					node->last_tuple = entry->tuples;
+					if (entry->tuples == NULL)
+					{
+						node->mstatus = MEMO_END_OF_SCAN;
+						return NULL;
+					}
+					node->mstatus = MEMO_CACHE_FETCH_NEXT_TUPLE;
+					return ExecStoreMinimalTuple(entry->tuples->mintuple,
+												 node->ss.ps.ps_ResultTupleSlot,
+												 false);
+				}
+
+				node->cache_misses++;
+				if (isnew)
+				{
+					entry->mem = sizeof(MemoizeEntry) +
+						GetMemoryChunkSpace(entry->shared.firstTuple);
+					node->mem_used += entry->mem;
+					dlist_push_head(&node->lru_list, &entry->lru_node);
+				}
+				else
+				{
+					/*
+					 * The last scan for this key stopped before the end, so
+					 * we don't have all its tuples.  Start over.
+					 */
+					memoize_remove_tuples(node, entry);
+					dlist_move_head(&node->lru_list, &entry->lru_node);
+				}
+				node->entry = entry;
+
+				/*
+				 * If the parameters have changed, the first ExecProcNode
+				 * rescans the subplan.  Otherwise we may have left it in the
+				 * middle of a scan, so rescan it here.
+				 */
+				if (outerNode->chgParam == NULL)
+					ExecReScan(outerNode);
+
+				slot = ExecProcNode(outerNode);
+				if (TupIsNull(slot))
+				{
+					entry->complete = true;
+					node->mstatus = MEMO_END_OF_SCAN;
+					return NULL;
+				}
+				if (!memoize_store_tuple(node, slot))
+				{
+					node->cache_overflows++;
+					node->mstatus = MEMO_CACHE_BYPASS_MODE;
+				}
+				else if (plannode->singlerow)
+				{
+					/* nobody is going to ask for more rows */
+					entry->complete = true;
+					node->mstatus = MEMO_END_OF_SCAN;
+				}
+				else
+					node->mstatus = MEMO_FILLING_CACHE;
+				return slot;
+			}
+
+		case MEMO_CACHE_FETCH_NEXT_TUPLE:
+			node->last_tuple = node->last_tuple->next;
+			if (node->last_tuple == NULL)
+			{
+				node->mstatus = MEMO_END_OF_SCAN;
+				return NULL;
+			}
+			return ExecStoreMinimalTuple(node->last_tuple->mintuple,
+										 node->ss.ps.ps_ResultTupleSlot,
+										 false);
+
+		case MEMO_FILLING_CACHE:
+			slot = ExecProcNode(outerNode);
+			if (TupIsNull(slot))
+			{
+				node->entry->complete = true;
+				node->mstatus = MEMO_END_OF_SCAN;
+				return NULL;
+			}
+			if (!memoize_store_tuple(node, slot))
+			{
+				node->cache_overflows++;
+				node->mstatus = MEMO_CACHE_BYPASS_MODE;
+			}
+			return slot;
+
+		case MEMO_CACHE_BYPASS_MODE:
+			slot = ExecProcNode(outerNode);
+			if (TupIsNull(slot))
+			{
+				node->mstatus = MEMO_END_OF_SCAN;
+				return NULL;
+			}
+			return slot;
+
+		case MEMO_END_OF_SCAN:
+			return NULL;
+
+		default:
+			elog(ERROR, "unrecognized memoize state: %d",
+				 node->mstatus);
+			return NULL;		/* keep compiler quiet */
+	}
+}
+
+/* ----------------------------------------------------------------
+ *		ExecInitMemoize
+ * ----------------------------------------------------------------
+ */
+MemoizeState *
+ExecInitMemoize(Memoize *node, EState *estate, int eflags)
+{
+	MemoizeState *mstate;
+	int			i;
+
+	/* check for unsupported flags */
+	Assert(!(eflags & (EXEC_FLAG_BACKWARD | EXEC_FLAG_MARK)));
+
+	/*
+	 * create state structure
+	 */
+	mstate = makeNode(MemoizeState);
+	mstate->ss.ps.plan = (Plan *) node;
+	mstate->ss.ps.state = estate;
+	mstate->mstatus = MEMO_CACHE_LOOKUP;
+
+	/*
+	 * Miscellaneous initialization
+	 *
+	 * We need an ExprContext to evaluate the cache key and for the hash
+	 * functions.
+	 */
+	ExecAssignExprContext(estate, &mstate->ss.ps);
+
+	mstate->param_exprs = (List *)
+		ExecInitExpr((Expr *) node->param_exprs, (PlanState *) mstate);
+	mstate->keyparamids = NULL;
+	(void) memoize_param_walker((Node *) node->param_exprs,
+								&mstate->keyparamids);
+
+	/*
+	 * tuple table initialization
+	 */
+	ExecInitResultTupleSlot(estate, &mstate->ss.ps);
+	ExecInitScanTupleSlot(estate, &mstate->ss);
+	mstate->probeslot = ExecInitExtraTupleSlot(estate);
+	ExecSetSlotDescriptor(mstate->probeslot,
+						  ExecTypeFromExprList(node->param_exprs));
+	mstate->removeslot = ExecInitExtraTupleSlot(estate);
+	ExecSetSlotDescriptor(mstate->removeslot,
+						  ExecTypeFromExprList(node->param_exprs));
+
+	/*
+	 * initialize child nodes.  We rescan the child for every cache miss, so
+	 * there's no point in asking it for cheap rewinds.
+	 */
+	eflags &= ~EXEC_FLAG_REWIND;
+	outerPlanState(mstate) = ExecInitNode(outerPlan(node), estate, eflags);
+
+	/*
+	 * initialize tuple type.  no need to initialize projection info because
+	 * this node doesn't do projections.
+	 */
+	ExecAssignResultTypeFromTL(&mstate->ss.ps);
+	ExecAssignScanTypeFromOuterPlan(&mstate->ss);
+	mstate->ss.ps.ps_ProjInfo = NULL;
+
+	/*
+	 * Set up the cache
+	 */
+	mstate->keyColIdx = (AttrNumber *)
+		palloc(node->numKeys * sizeof(AttrNumber));
+	for (i = 0; i < node->numKeys; i++)
+		mstate->keyColIdx[i] = i + 1;
+	execTuplesHashPrepare(node->numKeys,
+						  node->hashOperators,
+						  &mstate->eqfunctions,
+						  &mstate->hashfunctions);
+
+	mstate->tableContext =
+		AllocSetContextCreate(CurrentMemoryContext,
+							  "Memoize hash table",
+							  ALLOCSET_DEFAULT_MINSIZE,
+							  ALLOCSET_DEFAULT_INITSIZE,
+							  ALLOCSET_DEFAULT_MAXSIZE);
+	mstate->mem_limit = work_mem * 1024L;
+	mstate->mem_peak = 0;
+	mstate->cache_hits = 0;
+	mstate->cache_misses = 0;
+	mstate->cache_evictions = 0;
+	mstate->cache_overflows = 0;
+	build_memoize_table(mstate);
+
+	return mstate;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecEndMemoize
+ * ----------------------------------------------------------------
+ */
+void
+ExecEndMemoize(MemoizeState *node)
+{
+	/*
+	 * clean out the tuple table; the result slot may point into the cache
+	 */
+	ExecClearTuple(node->ss.ss_ScanTupleSlot);
+	ExecClearTuple(node->ss.ps.ps_ResultTupleSlot);
+	ExecClearTuple(node->probeslot);
+	ExecClearTuple(node->removeslot);
+
+	MemoryContextDelete(node->tableContext);
+
+	ExecFreeExprContext(&node->ss.ps);
+
+	/*
+	 * shut down the subplan
+	 */
+	ExecEndNode(outerPlanState(node));
+}
+
+/* ----------------------------------------------------------------
+ *		ExecReScanMemoize
+ *
+ *		The next call looks up the new parameter values.  We don't rescan
+ *		the subplan here, since we may not need it at all.
+ * ----------------------------------------------------------------
+ */
+void
+ExecReScanMemoize(MemoizeState *node)
+{
+	ExecClearTuple(node->ss.ps.ps_ResultTupleSlot);
+
+	/* If anything changed that isn't part of the key, forget everything */
+	if (bms_nonempty_difference(node->ss.ps.chgParam, node->keyparamids))
+		memoize_purge(node);
+
+	node->mstatus = MEMO_CACHE_LOOKUP;
+	node->entry = NULL;
+	node->last_tuple = NULL;
+}
@@ -56,7 +56,8 @@ static int	heap_compare_slots(Datum a, Datum b, void *arg);
 /* ----------------------------------------------------------------
  *		ExecInitMergeAppend
  *
- *		Begin all of the subscans of the MergeAppend node.
+ *		Begin all of the subscans of the MergeAppend node, except those
+ *		that ExecPruneSubplans finds can't return any rows.
  * ----------------------------------------------------------------
  */
 MergeAppendState *
@@ -65,16 +66,24 @@ ExecInitMergeAppend(MergeAppend *node, EState *estate, int eflags)
 	MergeAppendState *mergestate = makeNode(MergeAppendState);
 	PlanState **mergeplanstates;
 	int			nplans;
+	List	   *subplans;
 	int			i;
 	ListCell   *lc;
 
 	/* check for unsupported flags */
 	Assert(!(eflags & (EXEC_FLAG_BACKWARD | EXEC_FLAG_MARK)));
 
+	/*
+	 * Leave out the subplans that can't return any rows given the values of
+	 * the query's Params, if the planner told us how to find them.
+	 */
+	subplans = ExecPruneSubplans(estate, node->mergeplans,
+								 node->prunequals, node->pruneconstrs);
+
 	/*
 	 * Set up empty vector of subplan states
 	 */
-	nplans = list_length(node->mergeplans);
+	nplans = list_length(subplans);
 
 	mergeplanstates = (PlanState **) palloc0(nplans * sizeof(PlanState *));
 
@@ -108,7 +117,7 @@ ExecInitMergeAppend(MergeAppend *node, EState *estate, int eflags)
 	 * results into the array "mergeplans".
 	 */
 	i = 0;
-	foreach(lc, node->mergeplans)
+	foreach(lc, subplans)
 	{
 		Plan	   *initNode = (Plan *) lfirst(lc);
 
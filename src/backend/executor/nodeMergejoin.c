@@ -55,7 +55,9 @@
  *		to point at the first inner "5". This is done by "marking" the
  *		first inner 5 so we can restore the "cursor" to it before joining
  *		with the second outer 5. The access method interface provides
- *		routines to mark and restore to a tuple.
+ *		routines to mark and restore to a tuple.  When the inner plan is an
+ *		index scan we instead keep the tuples of the current inner key group
+ *		in a small tuplestore, and replay them from there; see MJFetchInner.
  *
  *
  *		Essential operation of the merge join algorithm is as follows:
@@ -95,6 +97,7 @@
 #include "access/nbtree.h"
 #include "executor/execdebug.h"
 #include "executor/nodeMergejoin.h"
+#include "miscadmin.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 
@@ -152,6 +155,113 @@ typedef enum
 	ExecCopySlot((mergestate)->mj_MarkedTupleSlot, (innerTupleSlot))
 
 
+/*
+ * MJFetchInner
+ *
+ * Fetch the next inner tuple.  When we are buffering inner key groups
+ * ourselves (see ExecInitMergeJoin), tuples remaining in the group buffer
+ * after a restore are returned first; tuples read from the inner plan while
+ * a group is marked are added to the buffer.
+ */
+static TupleTableSlot *
+MJFetchInner(MergeJoinState *mergestate)
+{
+	Tuplestorestate *group = mergestate->mj_InnerGroup;
+	TupleTableSlot *slot;
+
+	if (group == NULL)
+		return ExecProcNode(innerPlanState(mergestate));
+
+	if (!tuplestore_ateof(group) &&
+		tuplestore_gettupleslot(group, true, false,
+								mergestate->mj_InnerGroupSlot))
+		return mergestate->mj_InnerGroupSlot;
+
+	if (mergestate->mj_InnerEOF)
+		return NULL;
+
+	slot = ExecProcNode(innerPlanState(mergestate));
+	if (TupIsNull(slot))
+	{
+		mergestate->mj_InnerEOF = true;
+		return NULL;
+	}
+	if (mergestate->mj_BufferingGroup)
+		tuplestore_puttupleslot(group, slot);
+	return slot;
+}
+
+/*
+ * MJMarkInner
+ *
+ * Mark the inner position just after the current inner tuple, which is the
+ * first one of a new key group.  (The tuple itself is saved separately, by
+ * MarkInnerTuple.)
+ */
+static void
+MJMarkInner(MergeJoinState *mergestate)
+{
+	Tuplestorestate *group = mergestate->mj_InnerGroup;
+
+	if (group == NULL)
+	{
+		ExecMarkPos(innerPlanState(mergestate));
+		return;
+	}
+
+	if (tuplestore_ateof(group))
+	{
+		/*
+		 * Nothing buffered is needed any more.  Leave the active read pointer
+		 * at EOF, so that tuples added from now on are only read again after
+		 * a restore.
+		 */
+		tuplestore_clear(group);
+		(void) tuplestore_advance(group, true);
+	}
+	else
+	{
+		/* Still replaying an earlier group; the mark goes where we are */
+		tuplestore_copy_read_pointer(group, 0, 1);
+		tuplestore_trim(group);
+	}
+	mergestate->mj_BufferingGroup = true;
+}
+
+/*
+ * MJRestoreInner
+ *
+ * Go back to the position saved by MJMarkInner.
+ */
+static void
+MJRestoreInner(MergeJoinState *mergestate)
+{
+	if (mergestate->mj_InnerGroup == NULL)
+		ExecRestrPos(innerPlanState(mergestate));
+	else
+		tuplestore_copy_read_pointer(mergestate->mj_InnerGroup, 1, 0);
+}
+
+/*
+ * MJEndInnerGroup
+ *
+ * Called when the marked inner group can no longer match, so that the
+ * buffered tuples we have already read past can be discarded.
+ */
+static void
+MJEndInnerGroup(MergeJoinState *mergestate)
+{
+	Tuplestorestate *group = mergestate->mj_InnerGroup;
+
+	if (group == NULL)
+		return;
+
+	mergestate->mj_BufferingGroup = false;
+	tuplestore_copy_read_pointer(group, 0, 1);
+	tuplestore_trim(group);
+}
+
+
 /*
  * MJExamineQuals
  *
@@ -735,7 +845,7 @@ ExecMergeJoin(MergeJoinState *node)
 			case EXEC_MJ_INITIALIZE_INNER:
 				MJ_printf("ExecMergeJoin: EXEC_MJ_INITIALIZE_INNER\n");
 
-				innerTupleSlot = ExecProcNode(innerPlan);
+				innerTupleSlot = MJFetchInner(node);
 				node->mj_InnerTupleSlot = innerTupleSlot;
 
 				/* Compute join values and check for unmatchability */
@@ -912,7 +1022,7 @@ ExecMergeJoin(MergeJoinState *node)
 				 * NB: must NOT do "extraMarks" here, since we may need to
 				 * return to previously marked tuples.
 				 */
-				innerTupleSlot = ExecProcNode(innerPlan);
+				innerTupleSlot = MJFetchInner(node);
 				node->mj_InnerTupleSlot = innerTupleSlot;
 				MJ_DEBUG_PROC_NODE(innerTupleSlot);
 				node->mj_MatchedInner = false;
@@ -1111,7 +1221,7 @@ ExecMergeJoin(MergeJoinState *node)
 					 * forcing the merge clause to never match, so we never
 					 * get here.
 					 */
-					ExecRestrPos(innerPlan);
+					MJRestoreInner(node);
 
 					/*
 					 * ExecRestrPos probably should give us back a new Slot,
@@ -1144,6 +1254,7 @@ ExecMergeJoin(MergeJoinState *node)
 					 * ----------------
 					 */
 					Assert(compareResult > 0);
+					MJEndInnerGroup(node);
 					innerTupleSlot = node->mj_InnerTupleSlot;
 
 					/* reload comparison data for current inner */
@@ -1221,7 +1332,7 @@ ExecMergeJoin(MergeJoinState *node)
 
 				if (compareResult == 0)
 				{
-					ExecMarkPos(innerPlan);
+					MJMarkInner(node);
 
 					MarkInnerTuple(node->mj_InnerTupleSlot, node);
 
@@ -1328,7 +1439,7 @@ ExecMergeJoin(MergeJoinState *node)
 				/*
 				 * now we get the next inner tuple, if any
 				 */
-				innerTupleSlot = ExecProcNode(innerPlan);
+				innerTupleSlot = MJFetchInner(node);
 				node->mj_InnerTupleSlot = innerTupleSlot;
 				MJ_DEBUG_PROC_NODE(innerTupleSlot);
 				node->mj_MatchedInner = false;
@@ -1376,6 +1487,10 @@ ExecMergeJoin(MergeJoinState *node)
 
 				Assert(doFillInner);
 
+				/* no more restores, so stop buffering inner tuples */
+				if (node->mj_BufferingGroup)
+					MJEndInnerGroup(node);
+
 				if (!node->mj_MatchedInner)
 				{
 					/*
@@ -1398,7 +1513,7 @@ ExecMergeJoin(MergeJoinState *node)
 				/*
 				 * now we get the next inner tuple, if any
 				 */
-				innerTupleSlot = ExecProcNode(innerPlan);
+				innerTupleSlot = MJFetchInner(node);
 				node->mj_InnerTupleSlot = innerTupleSlot;
 				MJ_DEBUG_PROC_NODE(innerTupleSlot);
 				node->mj_MatchedInner = false;
@@ -1472,6 +1587,7 @@ MergeJoinState *
 ExecInitMergeJoin(MergeJoin *node, EState *estate, int eflags)
 {
 	MergeJoinState *mergestate;
+	bool		bufferInner;
 
 	/* check for unsupported flags */
 	Assert(!(eflags & (EXEC_FLAG_BACKWARD | EXEC_FLAG_MARK)));
@@ -1520,10 +1636,18 @@ ExecInitMergeJoin(MergeJoin *node, EState *estate, int eflags)
 	/*
 	 * initialize child nodes
 	 *
-	 * inner child must support MARK/RESTORE.
+	 * inner child must support MARK/RESTORE, unless we buffer the inner key
+	 * groups ourselves.  We do that for index scans: restoring one re-reads
+	 * the whole group through the index, while the group buffer is usually
+	 * just a few tuples in memory, and lets the index scan skip mark
+	 * bookkeeping altogether.
 	 */
+	bufferInner = (IsA(innerPlan(node), IndexScan) ||
+				   IsA(innerPlan(node), IndexOnlyScan));
+
 	outerPlanState(mergestate) = ExecInitNode(outerPlan(node), estate, eflags);
 	innerPlanState(mergestate) = ExecInitNode(innerPlan(node), estate,
+											  bufferInner ? eflags :
 											  eflags | EXEC_FLAG_MARK);
 
 	/*
@@ -1551,6 +1675,30 @@ ExecInitMergeJoin(MergeJoin *node, EState *estate, int eflags)
 	ExecSetSlotDescriptor(mergestate->mj_MarkedTupleSlot,
 						  ExecGetResultType(innerPlanState(mergestate)));
 
+	if (bufferInner)
+	{
+		/*
+		 * Read pointer 0 is the current position, pointer 1 the mark.  Both
+		 * only move forward, so the buffer can be trimmed as we go.
+		 */
+		mergestate->mj_InnerGroup = tuplestore_begin_heap(false, false,
+														  work_mem);
+		tuplestore_set_eflags(mergestate->mj_InnerGroup, 0);
+		(void) tuplestore_alloc_read_pointer(mergestate->mj_InnerGroup, 0);
+		(void) tuplestore_advance(mergestate->mj_InnerGroup, true);
+
+		mergestate->mj_InnerGroupSlot = ExecInitExtraTupleSlot(estate);
+		ExecSetSlotDescriptor(mergestate->mj_InnerGroupSlot,
+							  ExecGetResultType(innerPlanState(mergestate)));
+	}
+	else
+	{
+		mergestate->mj_InnerGroup = NULL;
+		mergestate->mj_InnerGroupSlot = NULL;
+	}
+	mergestate->mj_BufferingGroup = false;
+	mergestate->mj_InnerEOF = false;
+
 	switch (node->join.jointype)
 	{
 		case JOIN_INNER:
@@ -1668,6 +1816,16 @@ ExecEndMergeJoin(MergeJoinState *node)
 	ExecClearTuple(node->js.ps.ps_ResultTupleSlot);
 	ExecClearTuple(node->mj_MarkedTupleSlot);
 
+	/*
+	 * release the inner group buffer, if any
+	 */
+	if (node->mj_InnerGroup)
+	{
+		ExecClearTuple(node->mj_InnerGroupSlot);
+		tuplestore_end(node->mj_InnerGroup);
+		node->mj_InnerGroup = NULL;
+	}
+
 	/*
 	 * shut down the subplans
 	 */
@@ -1690,6 +1848,15 @@ ExecReScanMergeJoin(MergeJoinState *node)
 	node->mj_OuterTupleSlot = NULL;
 	node->mj_InnerTupleSlot = NULL;
 
+	if (node->mj_InnerGroup)
+	{
+		ExecClearTuple(node->mj_InnerGroupSlot);
+		tuplestore_clear(node->mj_InnerGroup);
+		(void) tuplestore_advance(node->mj_InnerGroup, true);
+	}
+	node->mj_BufferingGroup = false;
+	node->mj_InnerEOF = false;
+
 	/*
 	 * if chgParam of subnodes is not null then plans will be re-scanned by
 	 * first ExecProcNode.
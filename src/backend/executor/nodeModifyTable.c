@@ -61,6 +61,8 @@ static bool ExecOnConflictUpdate(ModifyTableState *mtstate,
 					 EState *estate,
 					 bool canSetTag,
 					 TupleTableSlot **returning);
+static void ExecBatchInsert(ResultRelInfo *resultRelInfo, EState *estate,
+				bool canSetTag);
 
 /*
  * Verify that the tuples to be produced by INSERT or UPDATE match the
@@ -294,6 +296,32 @@ ExecInsert(ModifyTableState *mtstate,
 	}
 	else if (resultRelInfo->ri_FdwRoutine)
 	{
+		/*
+		 * If the FDW supports batching, and batching was requested, just
+		 * queue a copy of the tuple; the batch is sent when it's full, or
+		 * when the subplan runs out of tuples.  Nothing that needs the
+		 * inserted tuple right away, such as RETURNING or AFTER ROW
+		 * triggers, is allowed in that case (see ExecInitModifyTable).
+		 */
+		if (resultRelInfo->ri_BatchSize > 1)
+		{
+			int			n = resultRelInfo->ri_NumSlots;
+
+			if (resultRelInfo->ri_Slots[n] == NULL)
+			{
+				resultRelInfo->ri_Slots[n] = ExecInitExtraTupleSlot(estate);
+				ExecSetSlotDescriptor(resultRelInfo->ri_Slots[n],
+									  slot->tts_tupleDescriptor);
+			}
+			ExecCopySlot(resultRelInfo->ri_Slots[n], slot);
+			resultRelInfo->ri_NumSlots++;
+
+			if (resultRelInfo->ri_NumSlots >= resultRelInfo->ri_BatchSize)
+				ExecBatchInsert(resultRelInfo, estate, canSetTag);
+
+			return NULL;
+		}
+
 		/*
 		 * insert into foreign table: let the FDW do it
 		 */
@@ -497,6 +525,35 @@ ExecInsert(ModifyTableState *mtstate,
 	return NULL;
 }
 
+/* ----------------------------------------------------------------
+ *		ExecBatchInsert
+ *
+ *		Sends the tuples queued by ExecInsert for a foreign table to the
+ *		FDW in one batch.
+ * ----------------------------------------------------------------
+ */
+static void
+ExecBatchInsert(ResultRelInfo *resultRelInfo, EState *estate, bool canSetTag)
+{
+	int			ninserted;
+	int			i;
+
+	if (resultRelInfo->ri_NumSlots == 0)
+		return;
+
+	ninserted = resultRelInfo->ri_FdwRoutine->ExecForeignBatchInsert(estate,
+															   resultRelInfo,
+													  resultRelInfo->ri_Slots,
+												  resultRelInfo->ri_NumSlots);
+
+	if (canSetTag)
+		estate->es_processed += ninserted;
+
+	for (i = 0; i < resultRelInfo->ri_NumSlots; i++)
+		ExecClearTuple(resultRelInfo->ri_Slots[i]);
+	resultRelInfo->ri_NumSlots = 0;
+}
+
 /* ----------------------------------------------------------------
  *		ExecDelete
  *
@@ -1333,6 +1390,10 @@ ExecModifyTable(ModifyTableState *node)
 
 		if (TupIsNull(planSlot))
 		{
+			/* send any tuples still queued for a batched foreign insert */
+			if (resultRelInfo->ri_NumSlots > 0)
+				ExecBatchInsert(resultRelInfo, estate, node->canSetTag);
+
 			/* advance to next subplan if any */
 			node->mt_whichplan++;
 			if (node->mt_whichplan < node->mt_nplans)
@@ -1349,6 +1410,13 @@ ExecModifyTable(ModifyTableState *node)
 				break;
 		}
 
+		/*
+		 * When the FDW modified the foreign table directly, the subplan has
+		 * done all the work already, and there is nothing to return.
+		 */
+		if (resultRelInfo->ri_usesFdwDirectModify)
+			continue;
+
 		EvalPlanQualSetSlot(&node->mt_epqstate, planSlot);
 		slot = planSlot;
 
@@ -1547,12 +1615,21 @@ ExecInitModifyTable(ModifyTable *node, EState *estate, int eflags)
 			resultRelInfo->ri_IndexRelationDescs == NULL)
 			ExecOpenIndices(resultRelInfo, mtstate->mt_onconflict != ONCONFLICT_NONE);
 
+		/*
+		 * If the FDW modifies this foreign table directly, the subplan is a
+		 * ForeignScan that does all the work; note that before initializing
+		 * it, so the FDW can tell.
+		 */
+		resultRelInfo->ri_usesFdwDirectModify =
+			bms_is_member(i, node->fdwDirectModifyPlans);
+
 		/* Now init the plan for this result rel */
 		estate->es_result_relation_info = resultRelInfo;
 		mtstate->mt_plans[i] = ExecInitNode(subplan, estate, eflags);
 
 		/* Also let FDWs init themselves for foreign-table result rels */
-		if (resultRelInfo->ri_FdwRoutine != NULL &&
+		if (!resultRelInfo->ri_usesFdwDirectModify &&
+			resultRelInfo->ri_FdwRoutine != NULL &&
 			resultRelInfo->ri_FdwRoutine->BeginForeignModify != NULL)
 		{
 			List	   *fdw_private = (List *) list_nth(node->fdwPrivLists, i);
@@ -1564,6 +1641,30 @@ ExecInitModifyTable(ModifyTable *node, EState *estate, int eflags)
 															 eflags);
 		}
 
+		/*
+		 * Ask the FDW how many rows to insert at a time.  Batching is only
+		 * possible when nothing needs to see each inserted row as soon as
+		 * it's inserted: no RETURNING, ON CONFLICT, WITH CHECK OPTION or
+		 * AFTER ROW triggers.
+		 */
+		resultRelInfo->ri_BatchSize = 1;
+		if (operation == CMD_INSERT &&
+			resultRelInfo->ri_FdwRoutine != NULL &&
+			resultRelInfo->ri_FdwRoutine->GetForeignModifyBatchSize != NULL &&
+			resultRelInfo->ri_FdwRoutine->ExecForeignBatchInsert != NULL &&
+			node->returningLists == NIL &&
+			node->onConflictAction == ONCONFLICT_NONE &&
+			node->withCheckOptionLists == NIL &&
+			!(resultRelInfo->ri_TrigDesc &&
+			  resultRelInfo->ri_TrigDesc->trig_insert_after_row))
+		{
+			resultRelInfo->ri_BatchSize =
+				resultRelInfo->ri_FdwRoutine->GetForeignModifyBatchSize(resultRelInfo);
+			if (resultRelInfo->ri_BatchSize > 1)
+				resultRelInfo->ri_Slots = (TupleTableSlot **)
+					palloc0(sizeof(TupleTableSlot *) * resultRelInfo->ri_BatchSize);
+		}
+
 		resultRelInfo++;
 		i++;
 	}
@@ -1879,7 +1980,8 @@ ExecEndModifyTable(ModifyTableState *node)
 	{
 		ResultRelInfo *resultRelInfo = node->resultRelInfo + i;
 
-		if (resultRelInfo->ri_FdwRoutine != NULL &&
+		if (!resultRelInfo->ri_usesFdwDirectModify &&
+			resultRelInfo->ri_FdwRoutine != NULL &&
 			resultRelInfo->ri_FdwRoutine->EndForeignModify != NULL)
 			resultRelInfo->ri_FdwRoutine->EndForeignModify(node->ps.state,
 														   resultRelInfo);
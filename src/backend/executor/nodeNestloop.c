@@ -17,15 +17,54 @@
  *		ExecNestLoop	 - process a nestloop join of two plans
  *		ExecInitNestLoop - initialize the join
  *		ExecEndNestLoop  - shut down the join
+ *
+ * Adaptive switching to a hash join:
+ *
+ * The planner picks a nestloop mostly when it expects few outer rows, and
+ * underestimating those is the classic way for a nestloop plan to go
+ * disastrously wrong.  So, if the inner side doesn't depend on the outer
+ * tuple and there is at least one hashable join clause, we count the outer
+ * rows, and once there are many more than estimated we build a hash table
+ * of the inner side and do the rest of the join as a hash join.  The rows
+ * joined so far stay valid: every outer row is joined exactly once, either
+ * by the nestloop or by the hash join, so nothing needs to be buffered or
+ * rescanned on the outer side.
+ *
+ * The hash join is made up on the fly from our own plan node and drives
+ * our own child plan states; it is not part of the plan state tree, so we
+ * have to take care of rescanning and shutting it down ourselves.
  */
 
 #include "postgres.h"
 
 #include "executor/execdebug.h"
+#include "executor/nodeHash.h"
+#include "executor/nodeHashjoin.h"
 #include "executor/nodeNestloop.h"
+#include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
+#include "optimizer/clauses.h"
+#include "utils/lsyscache.h"
 #include "utils/memutils.h"
 
 
+/* Switch to a hash join once we have read this many times the estimate */
+#define ADAPTIVE_JOIN_ESTIMATE_FACTOR	10.0
+
+/* ... but never before this many outer rows */
+#define ADAPTIVE_JOIN_MIN_ROWS			1000.0
+
+bool		enable_adaptive_join = true;
+
+/* bits set by join_clause_sides_walker */
+#define JOIN_SIDE_OUTER		0x01
+#define JOIN_SIDE_INNER		0x02
+#define JOIN_SIDE_OTHER		0x04
+
+static void ExecNestLoopInitAdaptive(NestLoopState *nlstate, NestLoop *node);
+static void ExecNestLoopSwitchToHash(NestLoopState *node);
+
+
 /* ----------------------------------------------------------------
  *		ExecNestLoop(node)
  *
@@ -69,6 +108,10 @@ ExecNestLoop(NestLoopState *node)
 	ExprContext *econtext;
 	ListCell   *lc;
 
+	/* If we have switched to a hash join, it does all the work */
+	if (node->nl_HashJoin != NULL)
+		return ExecHashJoin(node->nl_HashJoin);
+
 	/*
 	 * get information from the node
 	 */
@@ -119,6 +162,18 @@ ExecNestLoop(NestLoopState *node)
 		 */
 		if (node->nl_NeedNewOuter)
 		{
+			/*
+			 * If we have already read far more outer tuples than the planner
+			 * expected, let a hash join process the rest of them.
+			 */
+			if (node->nl_HashClauses != NIL &&
+				node->nl_OuterRows >= node->nl_SwitchRows)
+			{
+				ENL1_printf("switching to hash join");
+				ExecNestLoopSwitchToHash(node);
+				return ExecHashJoin(node->nl_HashJoin);
+			}
+
 			ENL1_printf("getting new outer tuple");
 			outerTupleSlot = ExecProcNode(outerPlan);
 
@@ -132,6 +187,7 @@ ExecNestLoop(NestLoopState *node)
 			}
 
 			ENL1_printf("saving new outer tuple information");
+			node->nl_OuterRows += 1;
 			econtext->ecxt_outertuple = outerTupleSlot;
 			node->nl_NeedNewOuter = false;
 			node->nl_MatchedOuter = false;
@@ -331,6 +387,8 @@ ExecInitNestLoop(NestLoop *node, EState *estate, int eflags)
 		ExecInitExpr((Expr *) node->join.joinqual,
 					 (PlanState *) nlstate);
 
+	ExecNestLoopInitAdaptive(nlstate, node);
+
 	/*
 	 * initialize child nodes
 	 *
@@ -409,6 +467,12 @@ ExecEndNestLoop(NestLoopState *node)
 	 */
 	ExecClearTuple(node->js.ps.ps_ResultTupleSlot);
 
+	/*
+	 * free the hash join we switched to, if any; it shares our subplans
+	 */
+	if (node->nl_HashJoin != NULL)
+		ExecEndHashJoinOverStates(node->nl_HashJoin);
+
 	/*
 	 * close down subplans
 	 */
@@ -428,6 +492,23 @@ ExecReScanNestLoop(NestLoopState *node)
 {
 	PlanState  *outerPlan = outerPlanState(node);
 
+	/*
+	 * Once we have switched to a hash join we stay with it, since the outer
+	 * side will likely be as big again.  Let its Hash node know about any
+	 * parameter change in our inner child, so that it can tell whether the
+	 * hash table can be kept; the hash join rescans the outer side itself.
+	 */
+	if (node->nl_HashJoin != NULL)
+	{
+		PlanState  *hashNode = innerPlanState(node->nl_HashJoin);
+
+		if (innerPlanState(node)->chgParam != NULL)
+			hashNode->chgParam = bms_add_members(hashNode->chgParam,
+											innerPlanState(node)->chgParam);
+		ExecReScanHashJoin(node->nl_HashJoin);
+		return;
+	}
+
 	/*
 	 * If outerPlan->chgParam is not null then plan will be automatically
 	 * re-scanned by first ExecProcNode.
@@ -444,4 +525,219 @@ ExecReScanNestLoop(NestLoopState *node)
 	node->js.ps.ps_TupFromTlist = false;
 	node->nl_NeedNewOuter = true;
 	node->nl_MatchedOuter = false;
+	node->nl_OuterRows = 0;
+}
+
+/*
+ * join_clause_sides_walker
+ *		Find out which sides of the join an expression refers to, as a mask
+ *		of JOIN_SIDE_* bits.  Anything whose value we can't be sure stays
+ *		the same across the hash table build counts as JOIN_SIDE_OTHER.
+ */
+static bool
+join_clause_sides_walker(Node *node, int *sides)
+{
+	if (node == NULL)
+		return false;
+	if (IsA(node, Var))
+	{
+		Var		   *var = (Var *) node;
+
+		if (var->varno == OUTER_VAR)
+			*sides |= JOIN_SIDE_OUTER;
+		else if (var->varno == INNER_VAR)
+			*sides |= JOIN_SIDE_INNER;
+		else
+			*sides |= JOIN_SIDE_OTHER;
+		return false;
+	}
+	if (IsA(node, Param) ||
+		IsA(node, SubPlan) ||
+		IsA(node, AlternativeSubPlan))
+	{
+		*sides |= JOIN_SIDE_OTHER;
+		return false;
+	}
+	return expression_tree_walker(node, join_clause_sides_walker,
+								  (void *) sides);
+}
+
+static int
+join_clause_sides(Node *node)
+{
+	int			sides = 0;
+
+	(void) join_clause_sides_walker(node, &sides);
+	return sides;
+}
+
+/*
+ * hashable_join_clause
+ *		If a join clause could serve as a hash clause, return it in the form
+ *		a hash join wants, with the outer argument first; else return NULL.
+ */
+static OpExpr *
+hashable_join_clause(Expr *clause)
+{
+	OpExpr	   *opexpr;
+	Node	   *leftarg;
+	Node	   *rightarg;
+	int			leftsides;
+	int			rightsides;
+	Oid			commutator;
+
+	if (!is_opclause(clause) || list_length(((OpExpr *) clause)->args) != 2)
+		return NULL;
+	opexpr = (OpExpr *) clause;
+	if (contain_volatile_functions((Node *) opexpr))
+		return NULL;
+
+	leftarg = linitial(opexpr->args);
+	rightarg = lsecond(opexpr->args);
+	leftsides = join_clause_sides(leftarg);
+	rightsides = join_clause_sides(rightarg);
+
+	if (leftsides == JOIN_SIDE_OUTER && rightsides == JOIN_SIDE_INNER)
+	{
+		if (!op_hashjoinable(opexpr->opno, exprType(leftarg)))
+			return NULL;
+		return opexpr;
+	}
+
+	if (leftsides == JOIN_SIDE_INNER && rightsides == JOIN_SIDE_OUTER)
+	{
+		commutator = get_commutator(opexpr->opno);
+		if (!OidIsValid(commutator) ||
+			!op_hashjoinable(commutator, exprType(rightarg)))
+			return NULL;
+		opexpr = (OpExpr *) copyObject(opexpr);
+		opexpr->opno = commutator;
+		opexpr->opfuncid = get_opcode(commutator);
+		opexpr->args = list_make2(lsecond(opexpr->args),
+								  linitial(opexpr->args));
+		return opexpr;
+	}
+
+	return NULL;
+}
+
+/*
+ * ExecNestLoopInitAdaptive
+ *		Decide whether this join may switch to a hash join later, and if so
+ *		sort its join clauses into hash clauses and others.
+ */
+static void
+ExecNestLoopInitAdaptive(NestLoopState *nlstate, NestLoop *node)
+{
+	List	   *hashclauses = NIL;
+	List	   *otherclauses = NIL;
+	ListCell   *lc;
+
+	nlstate->nl_HashClauses = NIL;
+	nlstate->nl_OtherJoinQual = NIL;
+	nlstate->nl_OuterRows = 0;
+	nlstate->nl_SwitchRows = Max(ADAPTIVE_JOIN_MIN_ROWS,
+								 ADAPTIVE_JOIN_ESTIMATE_FACTOR *
+								 outerPlan(node)->plan_rows);
+	nlstate->nl_SwitchedAfter = 0;
+	nlstate->nl_HashJoin = NULL;
+
+	/*
+	 * The inner side must give the same rows for every outer tuple, and the
+	 * hash join must compute the same join.  Subplans would have to be set
+	 * up again for the hash join, so don't bother with those.
+	 */
+	if (!enable_adaptive_join || node->nestParams != NIL)
+		return;
+	switch (node->join.jointype)
+	{
+		case JOIN_INNER:
+		case JOIN_LEFT:
+		case JOIN_SEMI:
+		case JOIN_ANTI:
+			break;
+		default:
+			return;
+	}
+	if (contain_subplans((Node *) node->join.plan.targetlist) ||
+		contain_subplans((Node *) node->join.plan.qual) ||
+		contain_subplans((Node *) node->join.joinqual))
+		return;
+
+	foreach(lc, node->join.joinqual)
+	{
+		Expr	   *clause = (Expr *) lfirst(lc);
+		OpExpr	   *hashclause = hashable_join_clause(clause);
+
+		if (hashclause != NULL)
+			hashclauses = lappend(hashclauses, hashclause);
+		else
+			otherclauses = lappend(otherclauses, clause);
+	}
+
+	if (hashclauses == NIL)
+		return;
+
+	nlstate->nl_HashClauses = hashclauses;
+	nlstate->nl_OtherJoinQual = otherclauses;
+}
+
+/*
+ * ExecNestLoopSwitchToHash
+ *		Make up a hash join doing the same join as this nestloop, over the
+ *		same child plan states, and start it.
+ */
+static void
+ExecNestLoopSwitchToHash(NestLoopState *node)
+{
+	NestLoop   *nl = (NestLoop *) node->js.ps.plan;
+	EState	   *estate = node->js.ps.state;
+	PlanState  *innerPlan = innerPlanState(node);
+	Plan	   *innerNode = innerPlan(nl);
+	MemoryContext oldcontext;
+	Hash	   *hash;
+	HashJoin   *hashjoin;
+	ListCell   *lc;
+
+	Assert(node->nl_HashJoin == NULL);
+	node->nl_SwitchedAfter = node->nl_OuterRows;
+
+	oldcontext = MemoryContextSwitchTo(estate->es_query_cxt);
+
+	/* The Hash node passes the inner tuples through unchanged */
+	hash = makeNode(Hash);
+	foreach(lc, innerNode->targetlist)
+	{
+		TargetEntry *tle = flatCopyTargetEntry((TargetEntry *) lfirst(lc));
+
+		tle->expr = (Expr *) makeVarFromTargetEntry(OUTER_VAR, tle);
+		hash->plan.targetlist = lappend(hash->plan.targetlist, tle);
+	}
+	hash->plan.startup_cost = innerNode->total_cost;
+	hash->plan.total_cost = innerNode->total_cost;
+	hash->plan.plan_rows = innerNode->plan_rows;
+	hash->plan.plan_width = innerNode->plan_width;
+	hash->plan.lefttree = innerNode;
+	hash->skewTable = InvalidOid;
+
+	/*
+	 * The hash join has our own targetlist, quals and costs; its targetlist
+	 * and quals refer to the outer and inner tuples the same way ours do.
+	 */
+	hashjoin = makeNode(HashJoin);
+	hashjoin->join = nl->join;
+	hashjoin->join.plan.type = T_HashJoin;
+	hashjoin->join.plan.initPlan = NIL;
+	hashjoin->join.plan.righttree = (Plan *) hash;
+	hashjoin->join.joinqual = node->nl_OtherJoinQual;
+	hashjoin->hashclauses = node->nl_HashClauses;
+
+	/* The last outer tuple may have left the inner scan anywhere */
+	ExecReScan(innerPlan);
+
+	node->nl_HashJoin = ExecInitHashJoinOverStates(hashjoin, estate, 0,
+												   outerPlanState(node),
+												   innerPlan);
+
+	MemoryContextSwitchTo(oldcontext);
 }
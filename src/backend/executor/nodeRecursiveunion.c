@@ -14,15 +14,30 @@
  */
 #include "postgres.h"
 
+#include "access/hash.h"
+#include "access/htup_details.h"
 #include "executor/execdebug.h"
 #include "executor/nodeRecursiveunion.h"
 #include "miscadmin.h"
+#include "storage/buffile.h"
 #include "utils/memutils.h"
 
 
 /*
- * To implement UNION (without ALL), we need a hashtable that stores tuples
- * already seen.  The hash key is computed from the grouping columns.
+ * To implement UNION (without ALL), or CYCLE, we need a hashtable that
+ * stores tuples already seen.  The hash key is computed from the grouping
+ * columns.
+ *
+ * If the hashtable outgrows work_mem, we switch to a partitioned scheme for
+ * the rest of the scan: the tuples seen so far are written out to one
+ * temporary file per batch, chosen by hash value, and each tuple produced
+ * after that is written to another per-batch file instead of being looked up
+ * right away.  When the step that is producing tuples is done, the batches
+ * are deduplicated one at a time, by loading the tuples already seen in a
+ * batch into the hashtable and then looking up the new ones; the ones not
+ * found are appended to the batch's file of seen tuples, and go to the
+ * working table and to the caller.  Only one batch has to fit in memory at a
+ * time, and the number of batches is doubled as needed to keep it so.
  */
 typedef struct RUHashEntryData *RUHashEntry;
 
@@ -31,26 +46,455 @@ typedef struct RUHashEntryData
 	TupleHashEntryData shared;	/* common header for hash table entries */
 }	RUHashEntryData;
 
+/*
+ * Rough memory usage of a hashtable entry, apart from its tuple: the entry,
+ * two buckets' worth of the bucket array, and palloc overhead.
+ */
+#define RU_ENTRY_OVERHEAD \
+	(MAXALIGN(sizeof(RUHashEntryData)) + 2 * sizeof(TupleHashBucketData) + \
+	 2 * 16)
+
+/* Upper limit on the number of batches, each of which has two files */
+#define RU_MAX_NBATCH		1024
+
+static void build_hash_table(RecursiveUnionState *rustate, long nbuckets);
+static bool recursive_union_filter(RecursiveUnionState *node,
+					   TupleTableSlot *slot);
+static uint32 ru_hash_slot(RecursiveUnionState *node, TupleTableSlot *slot);
+static int	ru_batchno(uint32 hashvalue, int nbatch);
+static void ru_save_tuple(MinimalTuple tuple, uint32 hashvalue,
+			  BufFile **fileptr, Size *space);
+static TupleTableSlot *ru_read_tuple(RecursiveUnionState *node, BufFile *file,
+			  uint32 *hashvalue);
+static void ru_start_spilling(RecursiveUnionState *node);
+static void ru_increase_nbatch(RecursiveUnionState *node);
+static void ru_begin_dedup(RecursiveUnionState *node);
+static TupleTableSlot *ru_next_spilled(RecursiveUnionState *node,
+				Tuplestorestate *output);
+static void ru_release_spill(RecursiveUnionState *node);
+
 
 /*
  * Initialize the hash table to empty.
  */
 static void
-build_hash_table(RecursiveUnionState *rustate)
+build_hash_table(RecursiveUnionState *rustate, long nbuckets)
 {
 	RecursiveUnion *node = (RecursiveUnion *) rustate->ps.plan;
 
 	Assert(node->numCols > 0);
-	Assert(node->numGroups > 0);
+	Assert(nbuckets > 0);
 
 	rustate->hashtable = BuildTupleHashTable(node->numCols,
 											 node->dupColIdx,
 											 rustate->eqfunctions,
 											 rustate->hashfunctions,
-											 node->numGroups,
+											 nbuckets,
 											 sizeof(RUHashEntryData),
 											 rustate->tableContext,
 											 rustate->tempContext);
+	rustate->hashMemUsed = 0;
+}
+
+/*
+ * Decide whether a tuple produced by one of the terms is to be returned now.
+ *
+ * Without spilling, that's the case if it isn't a duplicate of one seen
+ * before.  Once spilling, it's saved in its batch for the deduplication at
+ * the end of the step instead, and never returned here.
+ */
+static bool
+recursive_union_filter(RecursiveUnionState *node, TupleTableSlot *slot)
+{
+	TupleHashEntry entry;
+	bool		isnew;
+
+	if (node->nbatch > 0)
+	{
+		uint32		hashvalue = ru_hash_slot(node, slot);
+		int			batchno = ru_batchno(hashvalue, node->nbatch);
+
+		ru_save_tuple(ExecFetchSlotMinimalTuple(slot), hashvalue,
+					  &node->newFiles[batchno], &node->newSpace[batchno]);
+		return false;
+	}
+
+	/* Find or build hashtable entry for this tuple's group */
+	entry = LookupTupleHashEntry(node->hashtable, slot, &isnew);
+	/* Must reset temp context after each hashtable lookup */
+	MemoryContextReset(node->tempContext);
+	/* Ignore tuple if already seen */
+	if (!isnew)
+		return false;
+
+	node->hashMemUsed += RU_ENTRY_OVERHEAD + MAXALIGN(entry->firstTuple->t_len);
+	if (node->hashMemUsed > work_mem * 1024L)
+		ru_start_spilling(node);
+
+	return true;
+}
+
+/*
+ * Compute the hash value of a tuple's grouping columns, the same way the
+ * hashtable does.
+ */
+static uint32
+ru_hash_slot(RecursiveUnionState *node, TupleTableSlot *slot)
+{
+	RecursiveUnion *plan = (RecursiveUnion *) node->ps.plan;
+	MemoryContext oldcontext;
+	uint32		hashkey = 0;
+	int			i;
+
+	oldcontext = MemoryContextSwitchTo(node->tempContext);
+
+	for (i = 0; i < plan->numCols; i++)
+	{
+		Datum		attr;
+		bool		isNull;
+
+		/* rotate hashkey left 1 bit at each step */
+		hashkey = (hashkey << 1) | ((hashkey & 0x80000000) ? 1 : 0);
+
+		attr = slot_getattr(slot, plan->dupColIdx[i], &isNull);
+
+		if (!isNull)			/* treat nulls as having hash key 0 */
+			hashkey ^= DatumGetUInt32(FunctionCall1(&node->hashfunctions[i],
+													attr));
+	}
+
+	MemoryContextSwitchTo(oldcontext);
+	MemoryContextReset(node->tempContext);
+
+	return hashkey;
+}
+
+/*
+ * Batch number for a hash value.  The hashtable picks buckets by the low
+ * bits of the hash value, so the batch number is taken from a remix of it;
+ * otherwise, all the tuples of a batch would crowd into the same buckets.
+ */
+static int
+ru_batchno(uint32 hashvalue, int nbatch)
+{
+	return DatumGetUInt32(hash_uint32(hashvalue)) & (nbatch - 1);
+}
+
+/*
+ * Append a tuple and its hash value to a batch file, opening the file if
+ * needed, and add the space it takes to *space.
+ */
+static void
+ru_save_tuple(MinimalTuple tuple, uint32 hashvalue, BufFile **fileptr,
+			  Size *space)
+{
+	BufFile    *file = *fileptr;
+
+	if (file == NULL)
+	{
+		file = BufFileCreateTemp(false);
+		*fileptr = file;
+	}
+
+	if (BufFileWrite(file, (void *) &hashvalue, sizeof(uint32)) != sizeof(uint32) ||
+		BufFileWrite(file, (void *) tuple, tuple->t_len) != tuple->t_len)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write to recursive union temporary file: %m")));
+
+	*space += sizeof(uint32) + tuple->t_len;
+}
+
+/*
+ * Read the next tuple from a batch file into the spill slot, or return NULL
+ * at the end of the file.
+ */
+static TupleTableSlot *
+ru_read_tuple(RecursiveUnionState *node, BufFile *file, uint32 *hashvalue)
+{
+	uint32		header[2];
+	size_t		nread;
+	MinimalTuple tuple;
+
+	/* the hash value and the MinimalTuple length word are both uint32 */
+	nread = BufFileRead(file, (void *) header, sizeof(header));
+	if (nread == 0)
+		return NULL;
+	if (nread != sizeof(header))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read from recursive union temporary file: %m")));
+	*hashvalue = header[0];
+	tuple = (MinimalTuple) palloc(header[1]);
+	tuple->t_len = header[1];
+	nread = BufFileRead(file,
+						(void *) ((char *) tuple + sizeof(uint32)),
+						header[1] - sizeof(uint32));
+	if (nread != header[1] - sizeof(uint32))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read from recursive union temporary file: %m")));
+	return ExecStoreMinimalTuple(tuple, node->spillSlot, true);
+}
+
+/*
+ * Switch to the partitioned scheme: write the contents of the hashtable out
+ * to the batch files of seen tuples, and empty it.
+ */
+static void
+ru_start_spilling(RecursiveUnionState *node)
+{
+	MemoryContext oldcontext;
+	TupleHashIterator iter;
+	TupleHashEntry entry;
+	int			nbatch;
+
+	Assert(node->nbatch == 0);
+
+	/* aim for batches half full, leaving room for growth */
+	nbatch = 2;
+	while (nbatch < RU_MAX_NBATCH &&
+		   node->hashMemUsed / nbatch > work_mem * 1024L / 2)
+		nbatch <<= 1;
+
+	oldcontext = MemoryContextSwitchTo(node->ps.state->es_query_cxt);
+	node->nbatch = nbatch;
+	node->seenFiles = (BufFile **) palloc0(nbatch * sizeof(BufFile *));
+	node->newFiles = (BufFile **) palloc0(nbatch * sizeof(BufFile *));
+	node->seenSpace = (Size *) palloc0(nbatch * sizeof(Size));
+	node->newSpace = (Size *) palloc0(nbatch * sizeof(Size));
+	MemoryContextSwitchTo(oldcontext);
+
+	InitTupleHashIterator(node->hashtable, &iter);
+	while ((entry = ScanTupleHashTable(node->hashtable, &iter)) != NULL)
+	{
+		uint32		hashvalue;
+		int			batchno;
+
+		ExecStoreMinimalTuple(entry->firstTuple, node->spillSlot, false);
+		hashvalue = ru_hash_slot(node, node->spillSlot);
+		batchno = ru_batchno(hashvalue, nbatch);
+		ru_save_tuple(entry->firstTuple, hashvalue,
+					  &node->seenFiles[batchno], &node->seenSpace[batchno]);
+	}
+	TermTupleHashIterator(&iter);
+	ExecClearTuple(node->spillSlot);
+
+	MemoryContextResetAndDeleteChildren(node->tableContext);
+	node->hashtable = NULL;
+	node->hashMemUsed = 0;
+}
+
+/*
+ * Double the number of batches, splitting the files of each batch in two.
+ */
+static void
+ru_increase_nbatch(RecursiveUnionState *node)
+{
+	int			oldnbatch = node->nbatch;
+	int			nbatch = oldnbatch * 2;
+	MemoryContext oldcontext;
+	int			i;
+
+	oldcontext = MemoryContextSwitchTo(node->ps.state->es_query_cxt);
+	node->seenFiles = (BufFile **)
+		repalloc(node->seenFiles, nbatch * sizeof(BufFile *));
+	node->newFiles = (BufFile **)
+		repalloc(node->newFiles, nbatch * sizeof(BufFile *));
+	node->seenSpace = (Size *) repalloc(node->seenSpace, nbatch * sizeof(Size));
+	node->newSpace = (Size *) repalloc(node->newSpace, nbatch * sizeof(Size));
+	MemoryContextSwitchTo(oldcontext);
+
+	MemSet(node->seenFiles + oldnbatch, 0, oldnbatch * sizeof(BufFile *));
+	MemSet(node->newFiles + oldnbatch, 0, oldnbatch * sizeof(BufFile *));
+	MemSet(node->seenSpace + oldnbatch, 0, oldnbatch * sizeof(Size));
+	MemSet(node->newSpace + oldnbatch, 0, oldnbatch * sizeof(Size));
+	node->nbatch = nbatch;
+
+	/*
+	 * A tuple of batch i now belongs to batch i or i + oldnbatch.  The files
+	 * can't be rewritten in place, so both halves go to new files.
+	 */
+	for (i = 0; i < oldnbatch; i++)
+	{
+		BufFile   **files[2];
+		Size	   *spaces[2];
+		int			f;
+
+		files[0] = node->seenFiles;
+		files[1] = node->newFiles;
+		spaces[0] = node->seenSpace;
+		spaces[1] = node->newSpace;
+
+		for (f = 0; f < 2; f++)
+		{
+			BufFile    *oldfile = files[f][i];
+			TupleTableSlot *slot;
+			uint32		hashvalue;
+
+			if (oldfile == NULL)
+				continue;
+			files[f][i] = NULL;
+			spaces[f][i] = 0;
+
+			if (BufFileSeek(oldfile, 0, 0L, SEEK_SET))
+				ereport(ERROR,
+						(errcode_for_file_access(),
+						 errmsg("could not rewind recursive union temporary file: %m")));
+
+			while ((slot = ru_read_tuple(node, oldfile, &hashvalue)) != NULL)
+			{
+				int			batchno = ru_batchno(hashvalue, nbatch);
+
+				Assert(batchno == i || batchno == i + oldnbatch);
+				ru_save_tuple(ExecFetchSlotMinimalTuple(slot), hashvalue,
+							  &files[f][batchno], &spaces[f][batchno]);
+			}
+			ExecClearTuple(node->spillSlot);
+			BufFileClose(oldfile);
+		}
+	}
+}
+
+/*
+ * The step that was producing tuples is done: prepare to deduplicate the
+ * tuples it saved, batch by batch.
+ */
+static void
+ru_begin_dedup(RecursiveUnionState *node)
+{
+	for (;;)
+	{
+		Size		maxspace = 0;
+		int			i;
+
+		for (i = 0; i < node->nbatch; i++)
+			maxspace = Max(maxspace, node->seenSpace[i] + node->newSpace[i]);
+
+		if (maxspace <= work_mem * 1024L || node->nbatch >= RU_MAX_NBATCH)
+			break;
+		ru_increase_nbatch(node);
+	}
+
+	node->curbatch = 0;
+	node->batchLoaded = false;
+}
+
+/*
+ * Return the next tuple of the batches of the current step that is not a
+ * duplicate, after adding it to the output tuplestore, or NULL when all
+ * batches are done.
+ */
+static TupleTableSlot *
+ru_next_spilled(RecursiveUnionState *node, Tuplestorestate *output)
+{
+	while (node->curbatch < node->nbatch)
+	{
+		int			curbatch = node->curbatch;
+		TupleTableSlot *slot;
+		uint32		hashvalue;
+
+		if (!node->batchLoaded)
+		{
+			/* nothing to do for a batch the step produced nothing for */
+			if (node->newFiles[curbatch] == NULL)
+			{
+				node->curbatch++;
+				continue;
+			}
+
+			/* load the tuples already seen in the batch into the hashtable */
+			MemoryContextResetAndDeleteChildren(node->tableContext);
+			build_hash_table(node, Max(node->numGroups / node->nbatch, 1));
+
+			if (node->seenFiles[curbatch])
+			{
+				BufFile    *file = node->seenFiles[curbatch];
+				bool		isnew;
+
+				if (BufFileSeek(file, 0, 0L, SEEK_SET))
+					ereport(ERROR,
+							(errcode_for_file_access(),
+							 errmsg("could not rewind recursive union temporary file: %m")));
+				while ((slot = ru_read_tuple(node, file, &hashvalue)) != NULL)
+				{
+					LookupTupleHashEntry(node->hashtable, slot, &isnew);
+					MemoryContextReset(node->tempContext);
+				}
+
+				/*
+				 * The file is now positioned at its end, so the new tuples
+				 * found below get appended to it.
+				 */
+			}
+
+			if (BufFileSeek(node->newFiles[curbatch], 0, 0L, SEEK_SET))
+				ereport(ERROR,
+						(errcode_for_file_access(),
+						 errmsg("could not rewind recursive union temporary file: %m")));
+			node->batchLoaded = true;
+		}
+
+		while ((slot = ru_read_tuple(node, node->newFiles[curbatch],
+									 &hashvalue)) != NULL)
+		{
+			bool		isnew;
+
+			LookupTupleHashEntry(node->hashtable, slot, &isnew);
+			MemoryContextReset(node->tempContext);
+			if (!isnew)
+				continue;
+
+			ru_save_tuple(ExecFetchSlotMinimalTuple(slot), hashvalue,
+						  &node->seenFiles[curbatch],
+						  &node->seenSpace[curbatch]);
+			tuplestore_puttupleslot(output, slot);
+			return slot;
+		}
+
+		/* done with this batch */
+		BufFileClose(node->newFiles[curbatch]);
+		node->newFiles[curbatch] = NULL;
+		node->newSpace[curbatch] = 0;
+		node->batchLoaded = false;
+		node->curbatch++;
+	}
+
+	/* done with all batches; the hashtable is only used batch by batch */
+	MemoryContextResetAndDeleteChildren(node->tableContext);
+	node->hashtable = NULL;
+	node->curbatch = -1;
+
+	return NULL;
+}
+
+/*
+ * Close the batch files, and go back to the unpartitioned scheme.
+ */
+static void
+ru_release_spill(RecursiveUnionState *node)
+{
+	int			i;
+
+	for (i = 0; i < node->nbatch; i++)
+	{
+		if (node->seenFiles[i])
+			BufFileClose(node->seenFiles[i]);
+		if (node->newFiles[i])
+			BufFileClose(node->newFiles[i]);
+	}
+	if (node->nbatch > 0)
+	{
+		pfree(node->seenFiles);
+		pfree(node->newFiles);
+		pfree(node->seenSpace);
+		pfree(node->newSpace);
+	}
+	node->seenFiles = node->newFiles = NULL;
+	node->seenSpace = node->newSpace = NULL;
+	node->nbatch = 0;
+	node->curbatch = -1;
+	node->batchLoaded = false;
 }
 
 
@@ -79,26 +523,34 @@ ExecRecursiveUnion(RecursiveUnionState *node)
 	PlanState  *innerPlan = innerPlanState(node);
 	RecursiveUnion *plan = (RecursiveUnion *) node->ps.plan;
 	TupleTableSlot *slot;
-	bool		isnew;
 
 	/* 1. Evaluate non-recursive term */
 	if (!node->recursing)
 	{
 		for (;;)
 		{
+			if (node->curbatch >= 0)
+			{
+				/* Deduplicating the spilled tuples of this step */
+				slot = ru_next_spilled(node, node->working_table);
+				if (!TupIsNull(slot))
+					return slot;
+				break;
+			}
+
 			slot = ExecProcNode(outerPlan);
 			if (TupIsNull(slot))
-				break;
-			if (plan->numCols > 0)
 			{
-				/* Find or build hashtable entry for this tuple's group */
-				LookupTupleHashEntry(node->hashtable, slot, &isnew);
-				/* Must reset temp context after each hashtable lookup */
-				MemoryContextReset(node->tempContext);
-				/* Ignore tuple if already seen */
-				if (!isnew)
+				if (node->nbatch > 0)
+				{
+					ru_begin_dedup(node);
 					continue;
+				}
+				break;
 			}
+			/* Ignore tuple if already seen, or if it's spilled */
+			if (plan->numCols > 0 && !recursive_union_filter(node, slot))
+				continue;
 			/* Each non-duplicate tuple goes to the working table ... */
 			tuplestore_puttupleslot(node->working_table, slot);
 			/* ... and to the caller */
@@ -110,22 +562,44 @@ ExecRecursiveUnion(RecursiveUnionState *node)
 	/* 2. Execute recursive term */
 	for (;;)
 	{
-		slot = ExecProcNode(innerPlan);
+		if (node->curbatch >= 0)
+		{
+			/* Deduplicating the spilled tuples of this step */
+			slot = ru_next_spilled(node, node->intermediate_table);
+			if (!TupIsNull(slot))
+			{
+				node->intermediate_empty = false;
+				return slot;
+			}
+		}
+		else
+		{
+			slot = ExecProcNode(innerPlan);
+			if (TupIsNull(slot) && node->nbatch > 0)
+			{
+				ru_begin_dedup(node);
+				continue;
+			}
+		}
+
 		if (TupIsNull(slot))
 		{
+			Tuplestorestate *swaptemp;
+
 			/* Done if there's nothing in the intermediate table */
 			if (node->intermediate_empty)
 				break;
 
-			/* done with old working table ... */
-			tuplestore_end(node->working_table);
-
-			/* intermediate table becomes working table */
+			/*
+			 * Intermediate table becomes working table, and the old working
+			 * table is emptied to serve as the new intermediate table, which
+			 * lets its memory be reused rather than freed and allocated anew
+			 * at each step.
+			 */
+			swaptemp = node->working_table;
 			node->working_table = node->intermediate_table;
-
-			/* create new empty intermediate table */
-			node->intermediate_table = tuplestore_begin_heap(false, false,
-															 work_mem);
+			node->intermediate_table = swaptemp;
+			tuplestore_clear(node->intermediate_table);
 			node->intermediate_empty = true;
 
 			/* reset the recursive term */
@@ -136,16 +610,9 @@ ExecRecursiveUnion(RecursiveUnionState *node)
 			continue;
 		}
 
-		if (plan->numCols > 0)
-		{
-			/* Find or build hashtable entry for this tuple's group */
-			LookupTupleHashEntry(node->hashtable, slot, &isnew);
-			/* Must reset temp context after each hashtable lookup */
-			MemoryContextReset(node->tempContext);
-			/* Ignore tuple if already seen */
-			if (!isnew)
-				continue;
-		}
+		/* Ignore tuple if already seen, or if it's spilled */
+		if (plan->numCols > 0 && !recursive_union_filter(node, slot))
+			continue;
 
 		/* Else, tuple is good; stash it in intermediate table ... */
 		node->intermediate_empty = false;
@@ -182,6 +649,16 @@ ExecInitRecursiveUnion(RecursiveUnion *node, EState *estate, int eflags)
 	rustate->hashtable = NULL;
 	rustate->tempContext = NULL;
 	rustate->tableContext = NULL;
+	rustate->hashMemUsed = 0;
+	rustate->numGroups = node->numGroups;
+	rustate->nbatch = 0;
+	rustate->curbatch = -1;
+	rustate->batchLoaded = false;
+	rustate->seenFiles = NULL;
+	rustate->newFiles = NULL;
+	rustate->seenSpace = NULL;
+	rustate->newSpace = NULL;
+	rustate->spillSlot = NULL;
 
 	/* initialize processing state */
 	rustate->recursing = false;
@@ -233,6 +710,8 @@ ExecInitRecursiveUnion(RecursiveUnion *node, EState *estate, int eflags)
 	 * tuples, so we have to initialize them.
 	 */
 	ExecInitResultTupleSlot(estate, &rustate->ps);
+	if (node->numCols > 0)
+		rustate->spillSlot = ExecInitExtraTupleSlot(estate);
 
 	/*
 	 * Initialize result tuple type and projection info.  (Note: we have to
@@ -241,6 +720,9 @@ ExecInitRecursiveUnion(RecursiveUnion *node, EState *estate, int eflags)
 	 */
 	ExecAssignResultTypeFromTL(&rustate->ps);
 	rustate->ps.ps_ProjInfo = NULL;
+	if (rustate->spillSlot)
+		ExecSetSlotDescriptor(rustate->spillSlot,
+							  ExecGetResultType(&rustate->ps));
 
 	/*
 	 * initialize child nodes
@@ -258,7 +740,7 @@ ExecInitRecursiveUnion(RecursiveUnion *node, EState *estate, int eflags)
 							  node->dupOperators,
 							  &rustate->eqfunctions,
 							  &rustate->hashfunctions);
-		build_hash_table(rustate);
+		build_hash_table(rustate, node->numGroups);
 	}
 
 	return rustate;
@@ -277,6 +759,9 @@ ExecEndRecursiveUnion(RecursiveUnionState *node)
 	tuplestore_end(node->working_table);
 	tuplestore_end(node->intermediate_table);
 
+	/* Release batch files, if any */
+	ru_release_spill(node);
+
 	/* free subsidiary stuff including hashtable */
 	if (node->tempContext)
 		MemoryContextDelete(node->tempContext);
@@ -322,13 +807,14 @@ ExecReScanRecursiveUnion(RecursiveUnionState *node)
 	if (outerPlan->chgParam == NULL)
 		ExecReScan(outerPlan);
 
-	/* Release any hashtable storage */
+	/* Release any hashtable storage and batch files */
 	if (node->tableContext)
 		MemoryContextResetAndDeleteChildren(node->tableContext);
+	ru_release_spill(node);
 
 	/* And rebuild empty hashtable if needed */
 	if (plan->numCols > 0)
-		build_hash_table(node);
+		build_hash_table(node, plan->numGroups);
 
 	/* reset processing state */
 	node->recursing = false;
@@ -140,8 +140,7 @@ SampleScanState *
 ExecInitSampleScan(SampleScan *node, EState *estate, int eflags)
 {
 	SampleScanState *scanstate;
-	RangeTblEntry *rte = rt_fetch(node->scanrelid,
-								  estate->es_range_table);
+	RangeTblEntry *rte = exec_rt_fetch(node->scanrelid, estate);
 
 	Assert(outerPlan(node) == NULL);
 	Assert(innerPlan(node) == NULL);
@@ -19,16 +19,27 @@
  *		ExecInitSeqScan			creates and initializes a seqscan node.
  *		ExecEndSeqScan			releases any storage allocated.
  *		ExecReScanSeqScan		rescans the relation
+ *
+ *		ExecSeqScanEstimate		estimates DSM space needed for parallel scan
+ *		ExecSeqScanInitializeDSM initialize DSM for parallel scan
+ *		ExecSeqScanInitializeWorker attach to DSM info in parallel worker
  */
 #include "postgres.h"
 
 #include "access/relscan.h"
+#include "access/htup_details.h"
+#include "executor/execBatch.h"
 #include "executor/execdebug.h"
 #include "executor/nodeSeqscan.h"
+#include "storage/bufmgr.h"
+#include "utils/memutils.h"
 #include "utils/rel.h"
 
 static void InitScanRelation(SeqScanState *node, EState *estate, int eflags);
 static TupleTableSlot *SeqNext(SeqScanState *node);
+static TupleTableSlot *SeqNextBatch(SeqScanState *node, HeapScanDesc scandesc);
+static int	SeqFillBatch(SeqScanState *node, HeapScanDesc scandesc);
+static void SeqReleaseBatch(SeqScanState *node);
 
 /* ----------------------------------------------------------------
  *						Scan Support
@@ -53,10 +64,28 @@ SeqNext(SeqScanState *node)
 	/*
 	 * get information from the estate and scan state
 	 */
-	scandesc = node->ss_currentScanDesc;
-	estate = node->ps.state;
+	scandesc = node->ss.ss_currentScanDesc;
+	estate = node->ss.ps.state;
 	direction = estate->es_direction;
-	slot = node->ss_ScanTupleSlot;
+	slot = node->ss.ss_ScanTupleSlot;
+
+	if (scandesc == NULL)
+	{
+		/*
+		 * We reach here if the scan is not parallel, or if we're executing a
+		 * scan that was intended to be parallel serially.
+		 */
+		scandesc = heap_beginscan(node->ss.ss_currentRelation,
+								  estate->es_snapshot,
+								  0, NULL);
+		node->ss.ss_currentScanDesc = scandesc;
+	}
+
+	if (node->batchQual != NULL)
+	{
+		Assert(ScanDirectionIsForward(direction));
+		return SeqNextBatch(node, scandesc);
+	}
 
 	/*
 	 * get the next tuple from the table
@@ -83,17 +112,140 @@ SeqNext(SeqScanState *node)
 	return slot;
 }
 
+/* ----------------------------------------------------------------
+ *		SeqNextBatch
+ *
+ *		SeqNext for scans with batched quals: returns the next tuple
+ *		satisfying them, reading and filtering a new batch when the
+ *		current one is used up.
+ * ----------------------------------------------------------------
+ */
+static TupleTableSlot *
+SeqNextBatch(SeqScanState *node, HeapScanDesc scandesc)
+{
+	TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
+	HeapTuple	tuple;
+
+	while (node->batchNext >= node->batchNumSel)
+	{
+		int			ntuples;
+
+		ntuples = SeqFillBatch(node, scandesc);
+		if (ntuples == 0)
+			return ExecClearTuple(slot);
+
+		node->batchNumSel = ExecBatchQual(node->batchQual,
+										  node->batchTuples, ntuples,
+										  node->batchSlot,
+										  node->batchSel);
+		node->batchNext = 0;
+		InstrCountFiltered1(node, ntuples - node->batchNumSel);
+	}
+
+	tuple = &node->batchTuples[node->batchSel[node->batchNext++]];
+	return ExecStoreTuple(tuple, slot, node->batchBuffer, false);
+}
+
+/*
+ * SeqFillBatch -- read the next batch of tuples
+ *
+ * A batch is made up of tuples from a single page, so that they can all be
+ * kept valid by holding one extra pin, in node->batchBuffer.  We only find
+ * out that the scan has moved to the next page once heap_getnext returns a
+ * tuple from it; that tuple is kept aside as the first of the next batch.
+ * (Comparing buffers suffices to detect the page change, since the old
+ * buffer can't be recycled for the new page while we hold our pin.)
+ *
+ * Returns the number of tuples read, zero at the end of the scan.  Once
+ * heap_getnext has returned NULL we must not call it again, since that
+ * would start the scan over.
+ */
+static int
+SeqFillBatch(SeqScanState *node, HeapScanDesc scandesc)
+{
+	int			capacity = node->batchQual->capacity;
+	int			ntuples = 0;
+
+	SeqReleaseBatch(node);
+
+	if (node->batchDone)
+		return 0;
+
+	if (node->batchHavePending)
+	{
+		node->batchTuples[ntuples++] = node->batchPending;
+		node->batchHavePending = false;
+		node->batchBuffer = scandesc->rs_cbuf;
+		IncrBufferRefCount(node->batchBuffer);
+	}
+
+	while (ntuples < capacity)
+	{
+		HeapTuple	tuple = heap_getnext(scandesc, ForwardScanDirection);
+
+		if (tuple == NULL)
+		{
+			node->batchDone = true;
+			break;
+		}
+
+		if (ntuples == 0)
+		{
+			node->batchBuffer = scandesc->rs_cbuf;
+			IncrBufferRefCount(node->batchBuffer);
+		}
+		else if (scandesc->rs_cbuf != node->batchBuffer)
+		{
+			node->batchPending = *tuple;
+			node->batchHavePending = true;
+			break;
+		}
+
+		node->batchTuples[ntuples++] = *tuple;
+	}
+
+	return ntuples;
+}
+
+/*
+ * SeqReleaseBatch -- forget the current batch, if any
+ *
+ * A pending tuple is kept, since it's still valid as long as the scan
+ * hasn't advanced.
+ */
+static void
+SeqReleaseBatch(SeqScanState *node)
+{
+	if (BufferIsValid(node->batchBuffer))
+	{
+		ReleaseBuffer(node->batchBuffer);
+		node->batchBuffer = InvalidBuffer;
+	}
+	node->batchNumSel = 0;
+	node->batchNext = 0;
+}
+
 /*
  * SeqRecheck -- access method routine to recheck a tuple in EvalPlanQual
  */
 static bool
 SeqRecheck(SeqScanState *node, TupleTableSlot *slot)
 {
+	ExprContext *econtext;
+
 	/*
 	 * Note that unlike IndexScan, SeqScan never use keys in heap_beginscan
 	 * (and this is very bad) - so, here we do not check are keys ok or not.
+	 * However, quals we evaluate in batches are missing from ps.qual, so
+	 * they have to be checked here instead.
 	 */
-	return true;
+	if (node->batchQual == NULL)
+		return true;
+
+	econtext = node->ss.ps.ps_ExprContext;
+	econtext->ecxt_scantuple = slot;
+	ResetExprContext(econtext);
+	return ExecQual(node->batchQual->tupleQual, econtext, false);
 }
 
 /* ----------------------------------------------------------------
@@ -108,7 +260,7 @@ SeqRecheck(SeqScanState *node, TupleTableSlot *slot)
 TupleTableSlot *
 ExecSeqScan(SeqScanState *node)
 {
-	return ExecScan((ScanState *) node,
+	return ExecScan(&node->ss,
 					(ExecScanAccessMtd) SeqNext,
 					(ExecScanRecheckMtd) SeqRecheck);
 }
@@ -123,27 +275,30 @@ static void
 InitScanRelation(SeqScanState *node, EState *estate, int eflags)
 {
 	Relation	currentRelation;
-	HeapScanDesc currentScanDesc;
 
 	/*
 	 * get the relation object id from the relid'th entry in the range table,
 	 * open that relation and acquire appropriate lock on it.
 	 */
 	currentRelation = ExecOpenScanRelation(estate,
-									  ((SeqScan *) node->ps.plan)->scanrelid,
+								 ((SeqScan *) node->ss.ps.plan)->scanrelid,
 										   eflags);
 
-	/* initialize a heapscan */
-	currentScanDesc = heap_beginscan(currentRelation,
-									 estate->es_snapshot,
-									 0,
-									 NULL);
-
-	node->ss_currentRelation = currentRelation;
-	node->ss_currentScanDesc = currentScanDesc;
+	/*
+	 * Initialize a heapscan, unless this is a parallel-aware scan; in that
+	 * case the scan descriptor is set up once we know whether we're really
+	 * running in parallel, either by ExecSeqScanInitializeDSM (or the worker
+	 * equivalent) or, failing that, lazily by SeqNext.
+	 */
+	node->ss.ss_currentRelation = currentRelation;
+	if (!node->ss.ps.plan->parallel_aware)
+		node->ss.ss_currentScanDesc = heap_beginscan(currentRelation,
+												  estate->es_snapshot,
+												  0,
+												  NULL);
 
 	/* and report the scan tuple slot's rowtype */
-	ExecAssignScanType(node, RelationGetDescr(currentRelation));
+	ExecAssignScanType(&node->ss, RelationGetDescr(currentRelation));
 }
 
 
@@ -167,44 +322,74 @@ ExecInitSeqScan(SeqScan *node, EState *estate, int eflags)
 	 * create state structure
 	 */
 	scanstate = makeNode(SeqScanState);
-	scanstate->ps.plan = (Plan *) node;
-	scanstate->ps.state = estate;
+	scanstate->ss.ps.plan = (Plan *) node;
+	scanstate->ss.ps.state = estate;
 
 	/*
 	 * Miscellaneous initialization
 	 *
 	 * create expression context for node
 	 */
-	ExecAssignExprContext(estate, &scanstate->ps);
+	ExecAssignExprContext(estate, &scanstate->ss.ps);
 
 	/*
 	 * initialize child expressions
 	 */
-	scanstate->ps.targetlist = (List *)
+	scanstate->ss.ps.targetlist = (List *)
 		ExecInitExpr((Expr *) node->plan.targetlist,
-					 (PlanState *) scanstate);
-	scanstate->ps.qual = (List *)
-		ExecInitExpr((Expr *) node->plan.qual,
-					 (PlanState *) scanstate);
+					 &scanstate->ss.ps);
+	scanstate->batchBuffer = InvalidBuffer;
+	if (node->plan.qual != NIL && !(eflags & EXEC_FLAG_BACKWARD))
+	{
+		List	   *residual;
+
+		/*
+		 * Batches are read ahead of the tuples returned, so they only work
+		 * for forward scans.
+		 */
+		scanstate->batchQual = ExecInitBatchQual(node->plan.qual,
+												 node->scanrelid,
+												 MaxHeapTuplesPerPage,
+												 &scanstate->ss.ps,
+												 &residual);
+		scanstate->ss.ps.qual = (List *)
+			ExecInitExpr((Expr *) residual,
+						 &scanstate->ss.ps);
+	}
+	else
+		scanstate->ss.ps.qual = (List *)
+			ExecInitExpr((Expr *) node->plan.qual,
+						 &scanstate->ss.ps);
 
 	/*
 	 * tuple table initialization
 	 */
-	ExecInitResultTupleSlot(estate, &scanstate->ps);
-	ExecInitScanTupleSlot(estate, scanstate);
+	ExecInitResultTupleSlot(estate, &scanstate->ss.ps);
+	ExecInitScanTupleSlot(estate, &scanstate->ss);
 
 	/*
 	 * initialize scan relation
 	 */
 	InitScanRelation(scanstate, estate, eflags);
 
-	scanstate->ps.ps_TupFromTlist = false;
+	if (scanstate->batchQual != NULL)
+	{
+		scanstate->batchSlot = ExecInitExtraTupleSlot(estate);
+		ExecSetSlotDescriptor(scanstate->batchSlot,
+						  RelationGetDescr(scanstate->ss.ss_currentRelation));
+		scanstate->batchTuples = (HeapTupleData *)
+			palloc(MaxHeapTuplesPerPage * sizeof(HeapTupleData));
+		scanstate->batchSel = (int *)
+			palloc(MaxHeapTuplesPerPage * sizeof(int));
+	}
+
+	scanstate->ss.ps.ps_TupFromTlist = false;
 
 	/*
 	 * Initialize result tuple type and projection info.
 	 */
-	ExecAssignResultTypeFromTL(&scanstate->ps);
-	ExecAssignScanProjectionInfo(scanstate);
+	ExecAssignResultTypeFromTL(&scanstate->ss.ps);
+	ExecAssignScanProjectionInfo(&scanstate->ss);
 
 	return scanstate;
 }
@@ -224,24 +409,26 @@ ExecEndSeqScan(SeqScanState *node)
 	/*
 	 * get information from node
 	 */
-	relation = node->ss_currentRelation;
-	scanDesc = node->ss_currentScanDesc;
+	relation = node->ss.ss_currentRelation;
+	scanDesc = node->ss.ss_currentScanDesc;
 
 	/*
 	 * Free the exprcontext
 	 */
-	ExecFreeExprContext(&node->ps);
+	ExecFreeExprContext(&node->ss.ps);
 
 	/*
 	 * clean out the tuple table
 	 */
-	ExecClearTuple(node->ps.ps_ResultTupleSlot);
-	ExecClearTuple(node->ss_ScanTupleSlot);
+	ExecClearTuple(node->ss.ps.ps_ResultTupleSlot);
+	ExecClearTuple(node->ss.ss_ScanTupleSlot);
+	SeqReleaseBatch(node);
 
 	/*
 	 * close heap scan
 	 */
-	heap_endscan(scanDesc);
+	if (scanDesc != NULL)
+		heap_endscan(scanDesc);
 
 	/*
 	 * close the heap relation.
@@ -265,10 +452,90 @@ ExecReScanSeqScan(SeqScanState *node)
 {
 	HeapScanDesc scan;
 
-	scan = node->ss_currentScanDesc;
+	scan = node->ss.ss_currentScanDesc;
+
+	SeqReleaseBatch(node);
+	node->batchHavePending = false;
+	node->batchDone = false;
+
+	if (scan != NULL && scan->rs_parallel != NULL)
+	{
+		/*
+		 * The shared state of a parallel scan belongs to the Gather node
+		 * above us, which tears it down before rescanning us; so just drop
+		 * the scan and let it be set up afresh.
+		 */
+		heap_endscan(scan);
+		node->ss.ss_currentScanDesc = NULL;
+	}
+	else if (scan != NULL)
+		heap_rescan(scan,		/* scan desc */
+					NULL);		/* new scan keys */
+
+	ExecScanReScan(&node->ss);
+}
+
+/* ----------------------------------------------------------------
+ *						Parallel Scan Support
+ * ----------------------------------------------------------------
+ */
+
+/* ----------------------------------------------------------------
+ *		ExecSeqScanEstimate
+ *
+ *		estimates the space required to serialize seqscan node.
+ * ----------------------------------------------------------------
+ */
+void
+ExecSeqScanEstimate(SeqScanState *node,
+					ParallelContext *pcxt)
+{
+	shm_toc_estimate_chunk(&pcxt->estimator, heap_parallelscan_estimate());
+	shm_toc_estimate_keys(&pcxt->estimator, 1);
+}
 
-	heap_rescan(scan,			/* scan desc */
-				NULL);			/* new scan keys */
+/* ----------------------------------------------------------------
+ *		ExecSeqScanInitializeDSM
+ *
+ *		Set up a parallel heap scan descriptor.
+ * ----------------------------------------------------------------
+ */
+void
+ExecSeqScanInitializeDSM(SeqScanState *node,
+						 ParallelContext *pcxt)
+{
+	EState	   *estate = node->ss.ps.state;
+	ParallelHeapScanDesc pscan;
+
+	pscan = shm_toc_allocate(pcxt->toc, heap_parallelscan_estimate());
+	heap_parallelscan_initialize(pscan, node->ss.ss_currentRelation);
+	shm_toc_insert(pcxt->toc, node->ss.ps.plan->plan_node_id, pscan);
+
+	/* The leader participates in the scan, too. */
+	if (node->ss.ss_currentScanDesc != NULL)
+		heap_endscan(node->ss.ss_currentScanDesc);
+	node->ss.ss_currentScanDesc =
+		heap_beginscan_parallel(node->ss.ss_currentRelation,
+								estate->es_snapshot, pscan);
+}
 
-	ExecScanReScan((ScanState *) node);
+/* ----------------------------------------------------------------
+ *		ExecSeqScanInitializeWorker
+ *
+ *		Copy relevant information from TOC into planstate.
+ * ----------------------------------------------------------------
+ */
+void
+ExecSeqScanInitializeWorker(SeqScanState *node, shm_toc *toc)
+{
+	EState	   *estate = node->ss.ps.state;
+	ParallelHeapScanDesc pscan;
+
+	pscan = shm_toc_lookup(toc, node->ss.ps.plan->plan_node_id);
+	if (pscan == NULL)
+		elog(ERROR, "could not find parallel scan state for plan node %d",
+			 node->ss.ps.plan->plan_node_id);
+	node->ss.ss_currentScanDesc =
+		heap_beginscan_parallel(node->ss.ss_currentRelation,
+								estate->es_snapshot, pscan);
 }
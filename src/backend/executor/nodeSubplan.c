@@ -626,7 +626,7 @@ findPartialMatch(TupleHashTable hashtable, TupleTableSlot *slot,
 	TupleHashEntry entry;
 
 	InitTupleHashIterator(hashtable, &hashiter);
-	while ((entry = ScanTupleHashTable(&hashiter)) != NULL)
+	while ((entry = ScanTupleHashTable(hashtable, &hashiter)) != NULL)
 	{
 		ExecStoreMinimalTuple(entry->firstTuple, hashtable->tableslot, false);
 		if (!execTuplesUnequal(slot, hashtable->tableslot,
@@ -895,8 +895,18 @@ ExecInitSubPlan(SubPlan *subplan, PlanState *parent)
 									   &left_hashfn, &right_hashfn))
 				elog(ERROR, "could not find hash function for hash operator %u",
 					 opexpr->opno);
-			fmgr_info(left_hashfn, &sstate->lhs_hash_funcs[i - 1]);
-			fmgr_info(right_hashfn, &sstate->tab_hash_funcs[i - 1]);
+			if (left_hashfn == right_hashfn)
+			{
+				execHashFunctionInfo(left_hashfn,
+									 &sstate->lhs_hash_funcs[i - 1]);
+				execHashFunctionInfo(right_hashfn,
+									 &sstate->tab_hash_funcs[i - 1]);
+			}
+			else
+			{
+				fmgr_info(left_hashfn, &sstate->lhs_hash_funcs[i - 1]);
+				fmgr_info(right_hashfn, &sstate->tab_hash_funcs[i - 1]);
+			}
 
 			i++;
 		}
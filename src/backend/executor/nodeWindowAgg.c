@@ -152,6 +152,20 @@ typedef struct WindowStatePerAggData
 
 	int64		transValueCount;	/* number of currently-aggregated rows */
 
+	/*
+	 * For a min/max-like aggregate evaluated over a moving frame, the values
+	 * that may yet become the aggregate's result, in a double-ended queue
+	 * ordered by row position; see advance_windowaggregate_extremum().
+	 * transValue is kept equal to the first entry.
+	 */
+	bool		extremum;		/* use the queue instead of the transfn? */
+	FmgrInfo	sortopfn;		/* the aggregate's sort operator */
+	int64	   *extpos;			/* row positions of queued values */
+	Datum	   *extvalues;		/* queued input values */
+	int			exthead;		/* index of first queued entry */
+	int			exttail;		/* index after last queued entry */
+	int			extsize;		/* allocated length of arrays */
+
 	/* Data local to eval_windowaggregates() */
 	bool		restart;		/* need to restart this agg in this cycle? */
 } WindowStatePerAggData;
@@ -162,6 +176,11 @@ static void initialize_windowaggregate(WindowAggState *winstate,
 static void advance_windowaggregate(WindowAggState *winstate,
 						WindowStatePerFunc perfuncstate,
 						WindowStatePerAgg peraggstate);
+static void advance_windowaggregate_extremum(WindowAggState *winstate,
+								 WindowStatePerFunc perfuncstate,
+								 WindowStatePerAgg peraggstate);
+static void advance_windowaggregate_extremum_base(WindowAggState *winstate,
+									  WindowStatePerAgg peraggstate);
 static bool advance_windowaggregate_base(WindowAggState *winstate,
 							 WindowStatePerFunc perfuncstate,
 							 WindowStatePerAgg peraggstate);
@@ -228,6 +247,13 @@ initialize_windowaggregate(WindowAggState *winstate,
 	peraggstate->transValueCount = 0;
 	peraggstate->resultValue = (Datum) 0;
 	peraggstate->resultValueIsNull = true;
+
+	/* The queue's storage went away with the private aggcontext */
+	peraggstate->extpos = NULL;
+	peraggstate->extvalues = NULL;
+	peraggstate->exthead = 0;
+	peraggstate->exttail = 0;
+	peraggstate->extsize = 0;
 }
 
 /*
@@ -384,6 +410,150 @@ advance_windowaggregate(WindowAggState *winstate,
 	peraggstate->transValueIsNull = fcinfo->isnull;
 }
 
+/*
+ * advance_windowaggregate_extremum
+ * Add the current row to a min/max-like aggregate evaluated over a queue
+ *
+ * The result of such an aggregate is the input value that sorts first
+ * according to its sort operator (aggsortop), ignoring NULLs.  A value can
+ * only become the result while no later row with a value sorting at least as
+ * early is in the frame; since the frame's head and tail only ever move
+ * forward, we can discard such values as soon as the later row arrives.  The
+ * queue thus holds values in strictly sorted order, its first entry being
+ * the current result, and each row is added and removed at most once, so a
+ * sliding frame costs O(1) amortized per row instead of a rescan of the
+ * whole frame every time its head moves.
+ */
+static void
+advance_windowaggregate_extremum(WindowAggState *winstate,
+								 WindowStatePerFunc perfuncstate,
+								 WindowStatePerAgg peraggstate)
+{
+	WindowFuncExprState *wfuncstate = perfuncstate->wfuncstate;
+	ExprContext *econtext = winstate->tmpcontext;
+	ExprState  *filter = wfuncstate->aggfilter;
+	MemoryContext oldContext;
+	Datum		newVal;
+	bool		isnull;
+
+	oldContext = MemoryContextSwitchTo(econtext->ecxt_per_tuple_memory);
+
+	/* Skip anything FILTERed out */
+	if (filter)
+	{
+		Datum		res = ExecEvalExpr(filter, econtext, &isnull, NULL);
+
+		if (isnull || !DatumGetBool(res))
+		{
+			MemoryContextSwitchTo(oldContext);
+			return;
+		}
+	}
+
+	newVal = ExecEvalExpr((ExprState *) linitial(wfuncstate->args), econtext,
+						  &isnull, NULL);
+
+	/* The transfn is strict, so NULL inputs are ignored */
+	if (isnull)
+	{
+		MemoryContextSwitchTo(oldContext);
+		return;
+	}
+
+	/* Discard queued values that can no longer become the result */
+	while (peraggstate->exttail > peraggstate->exthead)
+	{
+		Datum		lastVal = peraggstate->extvalues[peraggstate->exttail - 1];
+
+		if (DatumGetBool(FunctionCall2Coll(&peraggstate->sortopfn,
+										   perfuncstate->winCollation,
+										   lastVal, newVal)))
+			break;
+		if (!peraggstate->transtypeByVal)
+			pfree(DatumGetPointer(lastVal));
+		peraggstate->exttail--;
+	}
+
+	/* Make room for the new entry */
+	MemoryContextSwitchTo(peraggstate->aggcontext);
+	if (peraggstate->extsize == 0)
+	{
+		peraggstate->extsize = 64;
+		peraggstate->extpos = (int64 *)
+			palloc(peraggstate->extsize * sizeof(int64));
+		peraggstate->extvalues = (Datum *)
+			palloc(peraggstate->extsize * sizeof(Datum));
+	}
+	else if (peraggstate->exttail >= peraggstate->extsize)
+	{
+		int			nentries = peraggstate->exttail - peraggstate->exthead;
+
+		if (peraggstate->exthead >= peraggstate->extsize / 2)
+		{
+			/* at least half the space is unused, so just compact it */
+			memmove(peraggstate->extpos,
+					peraggstate->extpos + peraggstate->exthead,
+					nentries * sizeof(int64));
+			memmove(peraggstate->extvalues,
+					peraggstate->extvalues + peraggstate->exthead,
+					nentries * sizeof(Datum));
+			peraggstate->exthead = 0;
+			peraggstate->exttail = nentries;
+		}
+		else
+		{
+			peraggstate->extsize *= 2;
+			peraggstate->extpos = (int64 *)
+				repalloc(peraggstate->extpos,
+						 peraggstate->extsize * sizeof(int64));
+			peraggstate->extvalues = (Datum *)
+				repalloc(peraggstate->extvalues,
+						 peraggstate->extsize * sizeof(Datum));
+		}
+	}
+
+	peraggstate->extpos[peraggstate->exttail] = winstate->aggregatedupto;
+	peraggstate->extvalues[peraggstate->exttail] =
+		datumCopy(newVal, peraggstate->transtypeByVal,
+				  peraggstate->transtypeLen);
+	peraggstate->exttail++;
+
+	MemoryContextSwitchTo(oldContext);
+
+	/* The first entry is the result */
+	peraggstate->transValue = peraggstate->extvalues[peraggstate->exthead];
+	peraggstate->transValueIsNull = false;
+}
+
+/*
+ * advance_windowaggregate_extremum_base
+ * Remove queued values that are no longer in the frame
+ */
+static void
+advance_windowaggregate_extremum_base(WindowAggState *winstate,
+									  WindowStatePerAgg peraggstate)
+{
+	while (peraggstate->exthead < peraggstate->exttail &&
+		   peraggstate->extpos[peraggstate->exthead] < winstate->frameheadpos)
+	{
+		if (!peraggstate->transtypeByVal)
+			pfree(DatumGetPointer(peraggstate->extvalues[peraggstate->exthead]));
+		peraggstate->exthead++;
+	}
+
+	if (peraggstate->exthead < peraggstate->exttail)
+	{
+		peraggstate->transValue = peraggstate->extvalues[peraggstate->exthead];
+		peraggstate->transValueIsNull = false;
+	}
+	else
+	{
+		peraggstate->exthead = peraggstate->exttail = 0;
+		peraggstate->transValue = (Datum) 0;
+		peraggstate->transValueIsNull = true;
+	}
+}
+
 /*
  * advance_windowaggregate_base
  * Remove the oldest tuple from an aggregation.
@@ -630,6 +800,7 @@ eval_windowaggregates(WindowAggState *winstate)
 	int			wfuncno,
 				numaggs,
 				numaggs_restart,
+				numaggs_extremum,
 				i;
 	int64		aggregatedupto_nonrestarted;
 	MemoryContext oldContext;
@@ -674,7 +845,11 @@ eval_windowaggregates(WindowAggState *winstate)
 	 * unable to remove the tuple from aggregation.  If this happens, or if
 	 * the aggregate doesn't have an inverse transition function at all, we
 	 * must perform the aggregation all over again for all tuples within the
-	 * new frame boundaries.
+	 * new frame boundaries.  Aggregates like min() and max(), whose result is
+	 * simply the input value that sorts first, are the exception: for them
+	 * we keep a queue of the values that could still become the result, and
+	 * drop those that fall off the top of the frame from it instead (see
+	 * advance_windowaggregate_extremum).
 	 *
 	 * In many common cases, multiple rows share the same frame and hence the
 	 * same aggregate value. (In particular, if there's no ORDER BY in a RANGE
@@ -731,7 +906,7 @@ eval_windowaggregates(WindowAggState *winstate)
 	 * We restart the aggregation:
 	 *	 - if we're processing the first row in the partition, or
 	 *	 - if the frame's head moved and we cannot use an inverse
-	 *	   transition function, or
+	 *	   transition function or an extremum queue, or
 	 *	 - if the new frame doesn't overlap the old one
 	 *
 	 * Note that we don't strictly need to restart in the last case, but if
@@ -740,19 +915,30 @@ eval_windowaggregates(WindowAggState *winstate)
 	 *----------
 	 */
 	numaggs_restart = 0;
+	numaggs_extremum = 0;
 	for (i = 0; i < numaggs; i++)
 	{
 		peraggstate = &winstate->peragg[i];
 		if (winstate->currentpos == 0 ||
 			(winstate->aggregatedbase != winstate->frameheadpos &&
-			 !OidIsValid(peraggstate->invtransfn_oid)) ||
+			 !OidIsValid(peraggstate->invtransfn_oid) &&
+			 !peraggstate->extremum) ||
 			winstate->aggregatedupto <= winstate->frameheadpos)
 		{
 			peraggstate->restart = true;
 			numaggs_restart++;
 		}
 		else
+		{
 			peraggstate->restart = false;
+
+			/* Extremum queues just drop the rows that left the frame */
+			if (peraggstate->extremum)
+			{
+				advance_windowaggregate_extremum_base(winstate, peraggstate);
+				numaggs_extremum++;
+			}
+		}
 	}
 
 	/*
@@ -762,7 +948,7 @@ eval_windowaggregates(WindowAggState *winstate)
 	 * i.e. advance_windowaggregate_base() can return false, in which case
 	 * we'll restart that aggregate below.
 	 */
-	while (numaggs_restart < numaggs &&
+	while (numaggs_restart + numaggs_extremum < numaggs &&
 		   winstate->aggregatedbase < winstate->frameheadpos)
 	{
 		/*
@@ -785,7 +971,7 @@ eval_windowaggregates(WindowAggState *winstate)
 			bool		ok;
 
 			peraggstate = &winstate->peragg[i];
-			if (peraggstate->restart)
+			if (peraggstate->restart || peraggstate->extremum)
 				continue;
 
 			wfuncno = peraggstate->wfuncno;
@@ -912,9 +1098,14 @@ eval_windowaggregates(WindowAggState *winstate)
 				continue;
 
 			wfuncno = peraggstate->wfuncno;
-			advance_windowaggregate(winstate,
-									&winstate->perfunc[wfuncno],
-									peraggstate);
+			if (peraggstate->extremum)
+				advance_windowaggregate_extremum(winstate,
+												 &winstate->perfunc[wfuncno],
+												 peraggstate);
+			else
+				advance_windowaggregate(winstate,
+										&winstate->perfunc[wfuncno],
+										peraggstate);
 		}
 
 		/* Reset per-input-tuple context after each tuple */
@@ -2301,6 +2492,30 @@ initialize_peragg(WindowAggState *winstate, WindowFunc *wfunc,
 				(errcode(ERRCODE_INVALID_FUNCTION_DEFINITION),
 				 errmsg("strictness of aggregate's forward and inverse transition functions must match")));
 
+	/*
+	 * Decide whether a min/max-like aggregate can be evaluated using an
+	 * extremum queue rather than by restarting it whenever the frame head
+	 * moves.  Its aggsortop says that its result is the input that sorts
+	 * first by that operator (as also assumed by planagg.c); insist as well
+	 * on the plain form of such aggregates, with a strict transfn, no initial
+	 * value, no finalfn and a single argument of the result type.  As for
+	 * moving aggregates, volatile arguments rule out the optimization.
+	 */
+	peraggstate->extremum = false;
+	if (OidIsValid(aggform->aggsortop) &&
+		!OidIsValid(invtransfn_oid) &&
+		!OidIsValid(finalfn_oid) &&
+		!(winstate->frameOptions & FRAMEOPTION_START_UNBOUNDED_PRECEDING) &&
+		peraggstate->transfn.fn_strict &&
+		peraggstate->initValueIsNull &&
+		numArguments == 1 &&
+		inputTypes[0] == wfunc->wintype &&
+		!contain_volatile_functions((Node *) wfunc))
+	{
+		peraggstate->extremum = true;
+		fmgr_info(get_opcode(aggform->aggsortop), &peraggstate->sortopfn);
+	}
+
 	/*
 	 * Moving aggregates use their own aggcontext.
 	 *
@@ -2313,9 +2528,10 @@ initialize_peragg(WindowAggState *winstate, WindowFunc *wfunc,
 	 * since we'd miss any indirectly referenced data.  We could, in theory,
 	 * make the memory allocation rules for moving aggregates different than
 	 * they have historically been for plain aggregates, but that seems grotty
-	 * and likely to lead to memory leaks.
+	 * and likely to lead to memory leaks.  The same goes for the queues of
+	 * extremum aggregates.
 	 */
-	if (OidIsValid(invtransfn_oid))
+	if (OidIsValid(invtransfn_oid) || peraggstate->extremum)
 		peraggstate->aggcontext =
 			AllocSetContextCreate(CurrentMemoryContext,
 								  "WindowAgg_AggregatePrivate",
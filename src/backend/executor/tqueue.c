@@ -0,0 +1,212 @@
+/*-------------------------------------------------------------------------
+ *
+ * tqueue.c
+ *	  Use shm_mq to send & receive tuples between parallel backends
+ *
+ * A DestReceiver of type DestTupleQueue, which is a TQueueDestReceiver
+ * under the hood, writes tuples from the executor to a shm_mq.
+ *
+ * A TupleQueueReader reads tuples from a shm_mq and returns the tuples.
+ *
+ * Tuples are transmitted as the raw HeapTupleHeader followed by its data,
+ * so this only works if both ends agree on the tuple descriptor, which is
+ * true for Gather since the leader and the workers run the same plan.
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * IDENTIFICATION
+ *	  src/backend/executor/tqueue.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/htup_details.h"
+#include "executor/tqueue.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+
+typedef struct
+{
+	DestReceiver pub;
+	shm_mq_handle *handle;
+	bool		detached;		/* receiver has gone away */
+} TQueueDestReceiver;
+
+struct TupleQueueReader
+{
+	shm_mq_handle *queue;
+};
+
+/*
+ * Receive a tuple.
+ *
+ * If the receiver has detached, which happens when the leader has decided it
+ * doesn't need any more tuples (e.g. because of a LIMIT), just remember that;
+ * the worker notices via TupleQueueDestReceiverDetached and stops early.
+ */
+static void
+tqueueReceiveSlot(TupleTableSlot *slot, DestReceiver *self)
+{
+	TQueueDestReceiver *tqueue = (TQueueDestReceiver *) self;
+	HeapTuple	tuple;
+	shm_mq_result result;
+
+	if (tqueue->detached)
+		return;
+
+	tuple = ExecMaterializeSlot(slot);
+	result = shm_mq_send(tqueue->handle, tuple->t_len, tuple->t_data, false);
+	if (result == SHM_MQ_DETACHED)
+		tqueue->detached = true;
+}
+
+/*
+ * Prepare to receive tuples from executor.
+ */
+static void
+tqueueStartupReceiver(DestReceiver *self, int operation, TupleDesc typeinfo)
+{
+	/* do nothing */
+}
+
+/*
+ * Clean up at end of an executor run
+ */
+static void
+tqueueShutdownReceiver(DestReceiver *self)
+{
+	/* do nothing */
+}
+
+/*
+ * Destroy receiver when done with it
+ */
+static void
+tqueueDestroyReceiver(DestReceiver *self)
+{
+	pfree(self);
+}
+
+/*
+ * Create a DestReceiver that writes tuples to a tuple queue.
+ */
+DestReceiver *
+CreateTupleQueueDestReceiver(shm_mq_handle *handle)
+{
+	TQueueDestReceiver *self;
+
+	self = (TQueueDestReceiver *) palloc0(sizeof(TQueueDestReceiver));
+
+	self->pub.receiveSlot = tqueueReceiveSlot;
+	self->pub.rStartup = tqueueStartupReceiver;
+	self->pub.rShutdown = tqueueShutdownReceiver;
+	self->pub.rDestroy = tqueueDestroyReceiver;
+	self->pub.mydest = DestTupleQueue;
+	self->handle = handle;
+	self->detached = false;
+
+	return (DestReceiver *) self;
+}
+
+/*
+ * Has the process reading from this tuple queue gone away?
+ */
+bool
+TupleQueueDestReceiverDetached(DestReceiver *self)
+{
+	Assert(self->mydest == DestTupleQueue);
+
+	return ((TQueueDestReceiver *) self)->detached;
+}
+
+/*
+ * Create a tuple queue reader.
+ */
+TupleQueueReader *
+CreateTupleQueueReader(shm_mq_handle *handle)
+{
+	TupleQueueReader *reader = palloc0(sizeof(TupleQueueReader));
+
+	reader->queue = handle;
+
+	return reader;
+}
+
+/*
+ * Destroy a tuple queue reader, detaching from the underlying queue so that
+ * the sender finds out we're not interested in any further tuples.
+ */
+void
+DestroyTupleQueueReader(TupleQueueReader *reader)
+{
+	shm_mq_detach(shm_mq_get_queue(reader->queue));
+	pfree(reader);
+}
+
+/*
+ * Fetch a tuple from a tuple queue reader.
+ *
+ * Even when nowait = false, we read from the individual queues in
+ * non-blocking mode and return NULL if no tuple is ready; the caller is
+ * expected to wait on its latch and retry.  *done is set to true when the
+ * sender has detached, meaning that no more tuples will ever arrive.
+ *
+ * The returned tuple is palloc'd in the current memory context.
+ */
+HeapTuple
+TupleQueueReaderNext(TupleQueueReader *reader, bool nowait, bool *done)
+{
+	shm_mq_result result;
+	Size		nbytes;
+	void	   *data;
+	HeapTupleData htup;
+
+	if (done != NULL)
+		*done = false;
+
+	for (;;)
+	{
+		/* Attempt to read a message. */
+		result = shm_mq_receive(reader->queue, &nbytes, &data, true);
+
+		/* If queue is detached, set *done and return NULL. */
+		if (result == SHM_MQ_DETACHED)
+		{
+			if (done != NULL)
+				*done = true;
+			return NULL;
+		}
+
+		/* In non-blocking mode, bail out if no message ready yet. */
+		if (result == SHM_MQ_WOULD_BLOCK)
+		{
+			if (nowait)
+				return NULL;
+
+			pgstat_report_wait_start(WAIT_EVENT_MQ_RECEIVE);
+			WaitLatch(MyLatch, WL_LATCH_SET, 0);
+			pgstat_report_wait_end();
+			ResetLatch(MyLatch);
+			CHECK_FOR_INTERRUPTS();
+			continue;
+		}
+
+		Assert(result == SHM_MQ_SUCCESS);
+		break;
+	}
+
+	/*
+	 * The data only remains valid until the next receive, so we must copy
+	 * it.  Set up a dummy HeapTupleData pointing to the data from the shm_mq
+	 * (which had better be sufficiently aligned).
+	 */
+	ItemPointerSetInvalid(&htup.t_self);
+	htup.t_tableOid = InvalidOid;
+	htup.t_len = nbytes;
+	htup.t_data = data;
+
+	return heap_copytuple(&htup);
+}
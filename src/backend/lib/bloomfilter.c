@@ -0,0 +1,176 @@
+/*-------------------------------------------------------------------------
+ *
+ * bloomfilter.c
+ *	  Space-efficient set membership testing
+ *
+ * The filter is sized for an expected number of elements, using about 8 bits
+ * per element if memory allows, which gives a false positive rate of about 2%
+ * with 6 bits set per element.  With fewer bits per element the number of
+ * bits set per element is reduced accordingly.  Adding more elements than
+ * expected makes the filter less selective, but never wrong.
+ *
+ * The bit positions for an element are derived from its hash value with
+ * "enhanced double hashing", as described by Dillinger and Manolios in
+ * "Bloom Filters in Probabilistic Verification", which only needs two
+ * independent hash values for any number of bits.
+ *
+ * Portions Copyright (c) 2015, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *	  src/backend/lib/bloomfilter.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include <math.h>
+
+#include "access/hash.h"
+#include "lib/bloomfilter.h"
+
+#define BLOOM_BITS_PER_ELEM		8
+#define BLOOM_MIN_BITS			(8 * 1024)
+#define BLOOM_MAX_HASH_FUNCS	10
+
+static inline void bloom_positions(bloom_filter *filter, uint32 hash,
+				uint32 *x, uint32 *y);
+
+/*
+ * bloom_create
+ *
+ * Create a Bloom filter for about total_elems elements, using no more than
+ * bloom_work_mem kilobytes of memory for its bitset (or a small minimum).
+ * The filter is allocated in the current memory context.
+ */
+bloom_filter *
+bloom_create(double total_elems, int bloom_work_mem)
+{
+	bloom_filter *filter;
+	double		target_bits;
+	double		max_bits;
+	uint32		nbits;
+	int			k;
+
+	total_elems = Max(total_elems, 1.0);
+	target_bits = total_elems * BLOOM_BITS_PER_ELEM;
+	max_bits = Min((double) bloom_work_mem * 1024.0 * BITS_PER_BYTE,
+				   (double) PG_UINT32_MAX);
+	target_bits = Min(target_bits, max_bits);
+
+	/* round down to a power of two, within limits */
+	nbits = BLOOM_MIN_BITS;
+	while ((double) nbits * 2 <= target_bits && nbits < ((uint32) 1 << 31))
+		nbits *= 2;
+
+	/* the optimal number of bits to set is ln(2) times the bits per element */
+	k = (int) rint(log(2.0) * nbits / total_elems);
+	k = Max(1, Min(k, BLOOM_MAX_HASH_FUNCS));
+
+	filter = palloc0(offsetof(bloom_filter, bitset) +
+					 (Size) nbits / BITS_PER_BYTE);
+	filter->k_hash_funcs = k;
+	filter->bitset_mask = nbits - 1;
+
+	return filter;
+}
+
+/*
+ * bloom_free
+ *
+ * Free a Bloom filter
+ */
+void
+bloom_free(bloom_filter *filter)
+{
+	pfree(filter);
+}
+
+/*
+ * bloom_add_hash
+ *
+ * Add an element, identified by its hash value, to the filter
+ */
+void
+bloom_add_hash(bloom_filter *filter, uint32 hash)
+{
+	uint32		x,
+				y;
+	int			i;
+
+	bloom_positions(filter, hash, &x, &y);
+
+	for (i = 0; i < filter->k_hash_funcs; i++)
+	{
+		filter->bitset[x >> 3] |= 1 << (x & 7);
+
+		x = (x + y) & filter->bitset_mask;
+		y = (y + i) & filter->bitset_mask;
+	}
+}
+
+/*
+ * bloom_lacks_hash
+ *
+ * Returns true if the element with the given hash value was certainly never
+ * added to the filter.  False means it might have been.
+ */
+bool
+bloom_lacks_hash(bloom_filter *filter, uint32 hash)
+{
+	uint32		x,
+				y;
+	int			i;
+
+	bloom_positions(filter, hash, &x, &y);
+
+	for (i = 0; i < filter->k_hash_funcs; i++)
+	{
+		if (!(filter->bitset[x >> 3] & (1 << (x & 7))))
+			return true;
+
+		x = (x + y) & filter->bitset_mask;
+		y = (y + i) & filter->bitset_mask;
+	}
+
+	return false;
+}
+
+/*
+ * bloom_prop_bits_set
+ *
+ * Returns the proportion of bits currently set in the filter.  The false
+ * positive rate is about this raised to the number of bits per element.
+ */
+double
+bloom_prop_bits_set(bloom_filter *filter)
+{
+	Size		nbytes = ((Size) filter->bitset_mask + 1) / BITS_PER_BYTE;
+	uint64		bits_set = 0;
+	Size		i;
+
+	for (i = 0; i < nbytes; i++)
+	{
+		unsigned char byte = filter->bitset[i];
+
+		while (byte)
+		{
+			bits_set++;
+			byte &= byte - 1;
+		}
+	}
+
+	return bits_set / (double) ((uint64) filter->bitset_mask + 1);
+}
+
+/*
+ * Compute the first bit position of an element, and the stride to the
+ * next one.  The caller's hash value is rehashed for the second value, so
+ * that the two are independent.
+ */
+static inline void
+bloom_positions(bloom_filter *filter, uint32 hash, uint32 *x, uint32 *y)
+{
+	*x = hash & filter->bitset_mask;
+	*y = DatumGetUInt32(hash_uint32(hash)) & filter->bitset_mask;
+}
@@ -72,6 +72,7 @@
 
 #include "libpq/libpq.h"
 #include "miscadmin.h"
+#include "pgstat.h"
 #include "storage/latch.h"
 #include "tcop/tcopprot.h"
 #include "utils/memutils.h"
@@ -387,7 +388,9 @@ aloop:
 				else
 					waitfor = WL_SOCKET_WRITEABLE;
 
+				pgstat_report_wait_start(WAIT_EVENT_SSL_OPEN_SERVER);
 				WaitLatchOrSocket(MyLatch, waitfor, port->sock, 0);
+				pgstat_report_wait_end();
 				goto aloop;
 			case SSL_ERROR_SYSCALL:
 				if (r < 0)
@@ -33,6 +33,7 @@
 
 #include "libpq/libpq.h"
 #include "miscadmin.h"
+#include "pgstat.h"
 #include "tcop/tcopprot.h"
 #include "utils/memutils.h"
 #include "storage/proc.h"
@@ -150,9 +151,11 @@ retry:
 
 		Assert(waitfor);
 
+		pgstat_report_wait_start(WAIT_EVENT_CLIENT_READ);
 		w = WaitLatchOrSocket(MyLatch,
 							  WL_LATCH_SET | waitfor,
 							  port->sock, 0);
+		pgstat_report_wait_end();
 
 		/* Handle interrupt. */
 		if (w & WL_LATCH_SET)
@@ -229,9 +232,11 @@ retry:
 
 		Assert(waitfor);
 
+		pgstat_report_wait_start(WAIT_EVENT_CLIENT_WRITE);
 		w = WaitLatchOrSocket(MyLatch,
 							  WL_LATCH_SET | waitfor,
 							  port->sock, 0);
+		pgstat_report_wait_end();
 
 		/* Handle interrupt. */
 		if (w & WL_LATCH_SET)
@@ -17,6 +17,7 @@
 #include "libpq/pqformat.h"
 #include "libpq/pqmq.h"
 #include "miscadmin.h"
+#include "pgstat.h"
 #include "tcop/tcopprot.h"
 #include "utils/builtins.h"
 
@@ -147,7 +148,9 @@ mq_putmessage(char msgtype, const char *s, size_t len)
 		if (result != SHM_MQ_WOULD_BLOCK)
 			break;
 
+		pgstat_report_wait_start(WAIT_EVENT_MQ_PUT_MESSAGE);
 		WaitLatch(&MyProc->procLatch, WL_LATCH_SET, 0);
+		pgstat_report_wait_end();
 		CHECK_FOR_INTERRUPTS();
 		ResetLatch(&MyProc->procLatch);
 	}
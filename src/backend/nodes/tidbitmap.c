@@ -19,6 +19,15 @@
  * of lossiness.  In theory we could fall back to page ranges at some
  * point, but for now that seems useless complexity.
  *
+ * Before giving up exactness, though, we try to make room by packing
+ * sparsely populated pages more tightly.  An exact page costs a whole
+ * hashtable entry with a full per-page bitmap, which is a lot for a page
+ * with only one or two interesting tuples, the usual case for a bitmap
+ * built from a selective index on a large table.  Such pages can instead be
+ * kept as a sorted array of offsets, shared by all the pages of a chunk-sized
+ * page range, so that a bitmap with a great many sparse pages can stay
+ * exact in the same amount of memory.
+ *
  * We also support the notion of candidate matches, or rechecking.  This
  * means we know that a search need visit only some tuples on a page,
  * but we are not certain that all of those tuples are real matches.
@@ -28,6 +37,10 @@
  * into a bitmap, and it can also happen internally when we AND a lossy
  * and a non-lossy page.
  *
+ * For a parallel bitmap heap scan, a finished bitmap can be copied into a
+ * caller-supplied chunk of shared memory, from which any number of
+ * processes then take pages one at a time; see tbm_shared_fill().
+ *
  *
  * Copyright (c) 2003-2015, PostgreSQL Global Development Group
  *
@@ -40,10 +53,13 @@
 
 #include <limits.h>
 
+#include "access/hash.h"
 #include "access/htup_details.h"
 #include "nodes/bitmapset.h"
 #include "nodes/tidbitmap.h"
+#include "storage/spin.h"
 #include "utils/hsearch.h"
+#include "utils/memutils.h"
 
 /*
  * The maximum number of tuples per page is not large (typically 256 with
@@ -97,11 +113,57 @@
 typedef struct PagetableEntry
 {
 	BlockNumber blockno;		/* page number (hashtable key) */
+	char		status;			/* hash entry status */
 	bool		ischunk;		/* T = lossy storage, F = exact */
 	bool		recheck;		/* should the tuples be rechecked? */
 	bitmapword	words[Max(WORDS_PER_PAGE, WORDS_PER_CHUNK)];
 } PagetableEntry;
 
+/*
+ * Packed pages live in a second hashtable, with one entry per range of
+ * PAGES_PER_CHUNK pages having any packed pages.  blockno is the first page
+ * of the range, as for a lossy chunk.  items is a sorted array of the TIDs
+ * of the packed pages in the range, each encoded as the page's position in
+ * the range in the upper 16 bits and the tuple offset in the lower ones.
+ * TBM_PACKED_RECHECK is set in all the items of a page whose tuples need to
+ * be rechecked; it is the same for all of them, so the items of each page
+ * still sort by offset.
+ *
+ * A page is in at most one of the exact, lossy and packed forms.  Pages are
+ * only packed under memory pressure, by tbm_compress(), and a packed page
+ * that gets more tuples added is made exact again.  That keeps the common
+ * paths as fast as before for bitmaps that fit in memory anyway.
+ */
+typedef struct PackedEntry
+{
+	BlockNumber blockno;		/* first page of range (hashtable key) */
+	int			nitems;			/* number of items in use */
+	int			maxitems;		/* allocated length of items[] */
+	uint32	   *items;			/* sorted packed TIDs, see above */
+} PackedEntry;
+
+#define TBM_PACKED_RECHECK	0x8000
+#define PACKED_ITEM(pageoff, off)	(((uint32) (pageoff) << 16) | (off))
+#define PACKED_PAGEOFF(item)		((int) ((item) >> 16))
+#define PACKED_OFFSET(item)			((OffsetNumber) ((item) & 0x7FFF))
+
+/*
+ * Pages with more tuples than this are left exact: beyond that, the items
+ * take up about as much space as the hashtable entry they'd replace.
+ */
+#define MAX_PACKED_PER_PAGE	8
+
+/*
+ * Approximate space taken by one hashtable entry, see tbm_create().  The
+ * space used by packed items is accounted for in these units too.
+ */
+#define TBM_ENTRY_SIZE \
+	(sizeof(PagetableEntry) + sizeof(Pointer) + sizeof(Pointer))
+
+#define TBM_USED_ENTRIES(tbm) \
+	((tbm)->nentries + (tbm)->npacked + \
+	 (tbm)->packedbytes / (long) TBM_ENTRY_SIZE)
+
 /*
  * dynahash.c is optimized for relatively large, long-lived hash tables.
  * This is not ideal for TIDBitMap, particularly when we are using a bitmap
@@ -111,7 +173,8 @@ typedef struct PagetableEntry
  * pagetable entry is needed, we store it in a fixed field of TIDBitMap.
  * (NOTE: we don't get rid of the hashtable if the bitmap later shrinks down
  * to zero or one page again.  So, status can be TBM_HASH even when nentries
- * is zero or one.)
+ * is zero or one.)  The packed-page hashtable only ever exists in TBM_HASH
+ * state.
  */
 typedef enum
 {
@@ -128,16 +191,20 @@ struct TIDBitmap
 	NodeTag		type;			/* to make it a valid Node */
 	MemoryContext mcxt;			/* memory context containing me */
 	TBMStatus	status;			/* see codes above */
-	HTAB	   *pagetable;		/* hash table of PagetableEntry's */
+	struct pagetable_hash *pagetable;	/* hash table of PagetableEntry's */
 	int			nentries;		/* number of entries in pagetable */
 	int			maxentries;		/* limit on same to meet maxbytes */
 	int			npages;			/* number of exact entries in pagetable */
 	int			nchunks;		/* number of lossy entries in pagetable */
+	HTAB	   *packtable;		/* hash table of PackedEntry's, or NULL */
+	int			npacked;		/* number of entries in packtable */
+	long		packedbytes;	/* space allocated for their items[] */
 	bool		iterating;		/* tbm_begin_iterate called? */
 	PagetableEntry entry1;		/* used when status == TBM_ONE_PAGE */
 	/* these are valid when iterating is true: */
 	PagetableEntry **spages;	/* sorted exact-page list, or NULL */
 	PagetableEntry **schunks;	/* sorted lossy-chunk list, or NULL */
+	PackedEntry **spacked;		/* sorted packed-range list, or NULL */
 };
 
 /*
@@ -152,6 +219,62 @@ struct TBMIterator
 	int			spageptr;		/* next spages index */
 	int			schunkptr;		/* next schunks index */
 	int			schunkbit;		/* next bit to check in current schunk */
+	int			spackedptr;		/* next spacked index */
+	int			spackeditem;	/* next item in current spacked entry */
+	TBMIterateResult output;	/* MUST BE LAST (because variable-size) */
+};
+
+/*
+ * A bitmap to be iterated by several processes at once is copied into a
+ * TBMSharedIteratorState, as a sequence of variable-size records, each
+ * starting on a MAXALIGN boundary after the state struct.  A record is a
+ * TBMSharedRecord header followed by
+ *
+ *	- for an exact page with few tuples, ntuples offsets;
+ *	- for any other exact page (ntuples == TBM_SHARED_WORDS), its bitmap
+ *	  words, as in a PagetableEntry;
+ *	- for a lossy chunk (ntuples == TBM_SHARED_CHUNK), its bitmap words.
+ *
+ * Records are in order of their blockno, so pages come out in roughly
+ * ascending order, except that all the pages of a lossy chunk are handed out
+ * before any exact page in its range.  Exact pages and lossy chunks take no
+ * more space than their hashtable entries, but a packed page takes somewhat
+ * more than its items did, so the records of a bitmap full of packed pages
+ * may not fit in the space it was built in.
+ *
+ * Once filled, the records are read-only.  The spinlock protects only the
+ * position of the next page to hand out, which is the record at offset
+ * next, and within a lossy chunk the page at bit nextbit.
+ */
+typedef struct TBMSharedRecord
+{
+	BlockNumber blockno;		/* page number, or first page of chunk */
+	int16		ntuples;		/* number of offsets, or one of below */
+	bool		recheck;		/* should the tuples be rechecked? */
+} TBMSharedRecord;
+
+#define TBM_SHARED_WORDS	(-1)
+#define TBM_SHARED_CHUNK	(-2)
+
+#define TBM_SHARED_RECORD_SIZE(ntuples) \
+	MAXALIGN(sizeof(TBMSharedRecord) + tbm_shared_payload_size(ntuples))
+
+struct TBMSharedIteratorState
+{
+	slock_t		mutex;			/* protects next and nextbit */
+	Size		size;			/* space available for records */
+	Size		used;			/* space filled with records */
+	Size		next;			/* offset of next record to hand out */
+	int			nextbit;		/* next bit to check in a lossy chunk */
+};
+
+#define TBM_SHARED_RECORDS(state) \
+	((char *) (state) + MAXALIGN(sizeof(TBMSharedIteratorState)))
+
+/* Process-local part of an iteration over a TBMSharedIteratorState */
+struct TBMSharedIterator
+{
+	TBMSharedIteratorState *state;	/* shared state we're iterating over */
 	TBMIterateResult output;	/* MUST BE LAST (because variable-size) */
 };
 
@@ -166,7 +289,40 @@ static PagetableEntry *tbm_get_pageentry(TIDBitmap *tbm, BlockNumber pageno);
 static bool tbm_page_is_lossy(const TIDBitmap *tbm, BlockNumber pageno);
 static void tbm_mark_page_lossy(TIDBitmap *tbm, BlockNumber pageno);
 static void tbm_lossify(TIDBitmap *tbm);
+static bool tbm_page_words(const TIDBitmap *tbm, BlockNumber pageno,
+			   bitmapword *words, bool *recheck);
+static PackedEntry *tbm_find_packed(const TIDBitmap *tbm, BlockNumber pageno);
+static void tbm_packed_range(const PackedEntry *pe, int pageoff,
+				 int *start, int *end);
+static void tbm_packed_words(const PackedEntry *pe, int start, int end,
+				 bitmapword *words, bool *recheck);
+static void tbm_delete_packed(TIDBitmap *tbm, PackedEntry *pe,
+				  int start, int end);
+static bool tbm_take_packed_page(TIDBitmap *tbm, BlockNumber pageno,
+					 bitmapword *words, bool *recheck);
+static void tbm_add_packed_page(TIDBitmap *tbm, BlockNumber pageno,
+					const bitmapword *words, bool recheck);
+static void tbm_compress(TIDBitmap *tbm);
+static int	tbm_extract_page_tuple(const bitmapword *words,
+					   TBMIterateResult *output);
+static Size tbm_shared_record(TBMSharedIteratorState *state, Size offset,
+				  BlockNumber blockno, int ntuples, bool recheck,
+				  const void *payload);
+static Size tbm_shared_payload_size(int ntuples);
 static int	tbm_comparator(const void *left, const void *right);
+static int	tbm_packed_comparator(const void *left, const void *right);
+
+/* define hashtable mapping block numbers to PagetableEntry's */
+#define SH_PREFIX pagetable
+#define SH_ELEMENT_TYPE PagetableEntry
+#define SH_KEY_TYPE BlockNumber
+#define SH_KEY blockno
+#define SH_HASH_KEY(tb, key) DatumGetUInt32(hash_uint32(key))
+#define SH_EQUAL(tb, a, b) ((a) == (b))
+#define SH_SCOPE static inline
+#define SH_DECLARE
+#define SH_DEFINE
+#include "lib/simplehash.h"
 
 
 /*
@@ -189,15 +345,13 @@ tbm_create(long maxbytes)
 	tbm->status = TBM_EMPTY;
 
 	/*
-	 * Estimate number of hashtable entries we can have within maxbytes. This
-	 * estimates the hash overhead at MAXALIGN(sizeof(HASHELEMENT)) plus a
-	 * pointer per hash entry, which is crude but good enough for our purpose.
-	 * Also count an extra Pointer per entry for the arrays created during
-	 * iteration readout.
+	 * Estimate number of hashtable entries we can have within maxbytes. The
+	 * entries are stored in the hashtable's array itself; count a pointer
+	 * per entry for the unused part of the array, which is crude but good
+	 * enough for our purpose.  Also count an extra Pointer per entry for the
+	 * arrays created during iteration readout.
 	 */
-	nbuckets = maxbytes /
-		(MAXALIGN(sizeof(HASHELEMENT)) + MAXALIGN(sizeof(PagetableEntry))
-		 + sizeof(Pointer) + sizeof(Pointer));
+	nbuckets = maxbytes / TBM_ENTRY_SIZE;
 	nbuckets = Min(nbuckets, INT_MAX - 1);		/* safety limit */
 	nbuckets = Max(nbuckets, 16);		/* sanity limit */
 	tbm->maxentries = (int) nbuckets;
@@ -212,32 +366,26 @@ tbm_create(long maxbytes)
 static void
 tbm_create_pagetable(TIDBitmap *tbm)
 {
-	HASHCTL		hash_ctl;
-
 	Assert(tbm->status != TBM_HASH);
 	Assert(tbm->pagetable == NULL);
 
-	/* Create the hashtable proper */
-	MemSet(&hash_ctl, 0, sizeof(hash_ctl));
-	hash_ctl.keysize = sizeof(BlockNumber);
-	hash_ctl.entrysize = sizeof(PagetableEntry);
-	hash_ctl.hcxt = tbm->mcxt;
-	tbm->pagetable = hash_create("TIDBitmap",
-								 128,	/* start small and extend */
-								 &hash_ctl,
-								 HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	/* Create the hashtable proper, starting small */
+	tbm->pagetable = pagetable_create(tbm->mcxt, 128, NULL);
 
 	/* If entry1 is valid, push it into the hashtable */
 	if (tbm->status == TBM_ONE_PAGE)
 	{
 		PagetableEntry *page;
 		bool		found;
+		char		oldstatus;
 
-		page = (PagetableEntry *) hash_search(tbm->pagetable,
-											  (void *) &tbm->entry1.blockno,
-											  HASH_ENTER, &found);
+		page = pagetable_insert(tbm->pagetable,
+								tbm->entry1.blockno,
+								&found);
 		Assert(!found);
+		oldstatus = page->status;
 		memcpy(page, &tbm->entry1, sizeof(PagetableEntry));
+		page->status = oldstatus;
 	}
 
 	tbm->status = TBM_HASH;
@@ -250,11 +398,23 @@ void
 tbm_free(TIDBitmap *tbm)
 {
 	if (tbm->pagetable)
-		hash_destroy(tbm->pagetable);
+		pagetable_destroy(tbm->pagetable);
+	if (tbm->packtable)
+	{
+		HASH_SEQ_STATUS status;
+		PackedEntry *pe;
+
+		hash_seq_init(&status, tbm->packtable);
+		while ((pe = (PackedEntry *) hash_seq_search(&status)) != NULL)
+			pfree(pe->items);
+		hash_destroy(tbm->packtable);
+	}
 	if (tbm->spages)
 		pfree(tbm->spages);
 	if (tbm->schunks)
 		pfree(tbm->schunks);
+	if (tbm->spacked)
+		pfree(tbm->spacked);
 	pfree(tbm);
 }
 
@@ -315,7 +475,7 @@ tbm_add_tuples(TIDBitmap *tbm, const ItemPointer tids, int ntids,
 		page->words[wordnum] |= ((bitmapword) 1 << bitnum);
 		page->recheck |= recheck;
 
-		if (tbm->nentries > tbm->maxentries)
+		if (TBM_USED_ENTRIES(tbm) > tbm->maxentries)
 		{
 			tbm_lossify(tbm);
 			/* Page could have been converted to lossy, so force new lookup */
@@ -336,7 +496,7 @@ tbm_add_page(TIDBitmap *tbm, BlockNumber pageno)
 	/* Enter the page in the bitmap, or mark it lossy if already present */
 	tbm_mark_page_lossy(tbm, pageno);
 	/* If we went over the memory limit, lossify some more pages */
-	if (tbm->nentries > tbm->maxentries)
+	if (TBM_USED_ENTRIES(tbm) > tbm->maxentries)
 		tbm_lossify(tbm);
 }
 
@@ -350,21 +510,71 @@ tbm_union(TIDBitmap *a, const TIDBitmap *b)
 {
 	Assert(!a->iterating);
 	/* Nothing to do if b is empty */
-	if (b->nentries == 0)
+	if (tbm_is_empty(b))
 		return;
 	/* Scan through chunks and pages in b, merge into a */
 	if (b->status == TBM_ONE_PAGE)
 		tbm_union_page(a, &b->entry1);
 	else
 	{
-		HASH_SEQ_STATUS status;
+		pagetable_iterator i;
 		PagetableEntry *bpage;
 
 		Assert(b->status == TBM_HASH);
-		hash_seq_init(&status, b->pagetable);
-		while ((bpage = (PagetableEntry *) hash_seq_search(&status)) != NULL)
+		pagetable_start_iterate(b->pagetable, &i);
+		while ((bpage = pagetable_iterate(b->pagetable, &i)) != NULL)
 			tbm_union_page(a, bpage);
 	}
+	/* Merge b's packed pages into a, keeping them packed where we can */
+	if (b->npacked > 0)
+	{
+		HASH_SEQ_STATUS status;
+		PackedEntry *pe;
+
+		hash_seq_init(&status, b->packtable);
+		while ((pe = (PackedEntry *) hash_seq_search(&status)) != NULL)
+		{
+			int			start = 0;
+
+			while (start < pe->nitems)
+			{
+				int			pageoff = PACKED_PAGEOFF(pe->items[start]);
+				BlockNumber pageno = pe->blockno + pageoff;
+				bitmapword	words[WORDS_PER_PAGE];
+				bool		recheck = false;
+				int			end = start;
+
+				while (end < pe->nitems &&
+					   PACKED_PAGEOFF(pe->items[end]) == pageoff)
+					end++;
+				MemSet(words, 0, sizeof(words));
+				tbm_packed_words(pe, start, end, words, &recheck);
+				start = end;
+
+				if (tbm_page_is_lossy(a, pageno))
+					continue;
+				if (tbm_find_pageentry(a, pageno) != NULL)
+				{
+					/* a has the page exact, so merge as usual */
+					PagetableEntry bpage;
+
+					MemSet(&bpage, 0, sizeof(bpage));
+					bpage.blockno = pageno;
+					bpage.recheck = recheck;
+					memcpy(bpage.words, words, sizeof(words));
+					tbm_union_page(a, &bpage);
+				}
+				else
+				{
+					if (a->status != TBM_HASH)
+						tbm_create_pagetable(a);
+					tbm_add_packed_page(a, pageno, words, recheck);
+					if (TBM_USED_ENTRIES(a) > a->maxentries)
+						tbm_lossify(a);
+				}
+			}
+		}
+	}
 }
 
 /* Process one page of b during a union op */
@@ -418,7 +628,7 @@ tbm_union_page(TIDBitmap *a, const PagetableEntry *bpage)
 		}
 	}
 
-	if (a->nentries > a->maxentries)
+	if (TBM_USED_ENTRIES(a) > a->maxentries)
 		tbm_lossify(a);
 }
 
@@ -432,7 +642,7 @@ tbm_intersect(TIDBitmap *a, const TIDBitmap *b)
 {
 	Assert(!a->iterating);
 	/* Nothing to do if a is empty */
-	if (a->nentries == 0)
+	if (tbm_is_empty(a))
 		return;
 	/* Scan through chunks and pages in a, try to match to b */
 	if (a->status == TBM_ONE_PAGE)
@@ -449,12 +659,12 @@ tbm_intersect(TIDBitmap *a, const TIDBitmap *b)
 	}
 	else
 	{
-		HASH_SEQ_STATUS status;
+		pagetable_iterator i;
 		PagetableEntry *apage;
 
 		Assert(a->status == TBM_HASH);
-		hash_seq_init(&status, a->pagetable);
-		while ((apage = (PagetableEntry *) hash_seq_search(&status)) != NULL)
+		pagetable_start_iterate(a->pagetable, &i);
+		while ((apage = pagetable_iterate(a->pagetable, &i)) != NULL)
 		{
 			if (tbm_intersect_page(a, apage, b))
 			{
@@ -464,13 +674,68 @@ tbm_intersect(TIDBitmap *a, const TIDBitmap *b)
 				else
 					a->npages--;
 				a->nentries--;
-				if (hash_search(a->pagetable,
-								(void *) &apage->blockno,
-								HASH_REMOVE, NULL) == NULL)
-					elog(ERROR, "hash table corrupted");
+				pagetable_delete_item(a->pagetable, apage);
 			}
 		}
 	}
+	/* Filter a's packed pages in place */
+	if (a->npacked > 0)
+	{
+		HASH_SEQ_STATUS status;
+		PackedEntry *pe;
+
+		hash_seq_init(&status, a->packtable);
+		while ((pe = (PackedEntry *) hash_seq_search(&status)) != NULL)
+		{
+			int			start = 0;
+			int			nkept = 0;
+
+			while (start < pe->nitems)
+			{
+				int			pageoff = PACKED_PAGEOFF(pe->items[start]);
+				BlockNumber pageno = pe->blockno + pageoff;
+				bitmapword	bwords[WORDS_PER_PAGE];
+				bool		brecheck = false;
+				int			end = start;
+				int			i;
+
+				while (end < pe->nitems &&
+					   PACKED_PAGEOFF(pe->items[end]) == pageoff)
+					end++;
+
+				if (tbm_page_is_lossy(b, pageno))
+				{
+					/* keep all the page's tuples, but recheck them */
+					for (i = start; i < end; i++)
+						pe->items[nkept++] = pe->items[i] | TBM_PACKED_RECHECK;
+				}
+				else if (tbm_page_words(b, pageno, bwords, &brecheck))
+				{
+					int			pagekept = nkept;
+
+					for (i = start; i < end; i++)
+					{
+						int			bitno = PACKED_OFFSET(pe->items[i]) - 1;
+
+						if (bwords[WORDNUM(bitno)] &
+							((bitmapword) 1 << BITNUM(bitno)))
+							pe->items[nkept++] = pe->items[i];
+					}
+					if (brecheck)
+					{
+						for (i = pagekept; i < nkept; i++)
+							pe->items[i] |= TBM_PACKED_RECHECK;
+					}
+				}
+				/* else the page is not in b at all, so drop it */
+				start = end;
+			}
+
+			pe->nitems = nkept;
+			if (nkept == 0)
+				tbm_delete_packed(a, pe, 0, 0);
+		}
+	}
 }
 
 /*
@@ -481,12 +746,13 @@ tbm_intersect(TIDBitmap *a, const TIDBitmap *b)
 static bool
 tbm_intersect_page(TIDBitmap *a, PagetableEntry *apage, const TIDBitmap *b)
 {
-	const PagetableEntry *bpage;
 	int			wordnum;
 
 	if (apage->ischunk)
 	{
 		/* Scan each bit in chunk, try to clear */
+		bitmapword	bwords[WORDS_PER_PAGE];
+		bool		brecheck;
 		bool		candelete = true;
 
 		for (wordnum = 0; wordnum < WORDS_PER_CHUNK; wordnum++)
@@ -506,7 +772,7 @@ tbm_intersect_page(TIDBitmap *a, PagetableEntry *apage, const TIDBitmap *b)
 					if (w & 1)
 					{
 						if (!tbm_page_is_lossy(b, pg) &&
-							tbm_find_pageentry(b, pg) == NULL)
+							!tbm_page_words(b, pg, bwords, &brecheck))
 						{
 							/* Page is not in b at all, lose lossy bit */
 							neww &= ~((bitmapword) 1 << bitnum);
@@ -536,20 +802,20 @@ tbm_intersect_page(TIDBitmap *a, PagetableEntry *apage, const TIDBitmap *b)
 	}
 	else
 	{
+		bitmapword	bwords[WORDS_PER_PAGE];
+		bool		brecheck = false;
 		bool		candelete = true;
 
-		bpage = tbm_find_pageentry(b, apage->blockno);
-		if (bpage != NULL)
+		if (tbm_page_words(b, apage->blockno, bwords, &brecheck))
 		{
 			/* Both pages are exact, merge at the bit level */
-			Assert(!bpage->ischunk);
 			for (wordnum = 0; wordnum < WORDS_PER_PAGE; wordnum++)
 			{
-				apage->words[wordnum] &= bpage->words[wordnum];
+				apage->words[wordnum] &= bwords[wordnum];
 				if (apage->words[wordnum] != 0)
 					candelete = false;
 			}
-			apage->recheck |= bpage->recheck;
+			apage->recheck |= brecheck;
 		}
 		/* If there is no matching b page, we can just delete the a page */
 		return candelete;
@@ -562,7 +828,7 @@ tbm_intersect_page(TIDBitmap *a, PagetableEntry *apage, const TIDBitmap *b)
 bool
 tbm_is_empty(const TIDBitmap *tbm)
 {
-	return (tbm->nentries == 0);
+	return (tbm->nentries == 0 && tbm->npacked == 0);
 }
 
 /*
@@ -597,6 +863,8 @@ tbm_begin_iterate(TIDBitmap *tbm)
 	iterator->spageptr = 0;
 	iterator->schunkptr = 0;
 	iterator->schunkbit = 0;
+	iterator->spackedptr = 0;
+	iterator->spackeditem = 0;
 
 	/*
 	 * If we have a hashtable, create and fill the sorted page lists, unless
@@ -606,7 +874,7 @@ tbm_begin_iterate(TIDBitmap *tbm)
 	 */
 	if (tbm->status == TBM_HASH && !tbm->iterating)
 	{
-		HASH_SEQ_STATUS status;
+		pagetable_iterator i;
 		PagetableEntry *page;
 		int			npages;
 		int			nchunks;
@@ -620,9 +888,9 @@ tbm_begin_iterate(TIDBitmap *tbm)
 				MemoryContextAlloc(tbm->mcxt,
 								   tbm->nchunks * sizeof(PagetableEntry *));
 
-		hash_seq_init(&status, tbm->pagetable);
+		pagetable_start_iterate(tbm->pagetable, &i);
 		npages = nchunks = 0;
-		while ((page = (PagetableEntry *) hash_seq_search(&status)) != NULL)
+		while ((page = pagetable_iterate(tbm->pagetable, &i)) != NULL)
 		{
 			if (page->ischunk)
 				tbm->schunks[nchunks++] = page;
@@ -637,6 +905,25 @@ tbm_begin_iterate(TIDBitmap *tbm)
 		if (nchunks > 1)
 			qsort(tbm->schunks, nchunks, sizeof(PagetableEntry *),
 				  tbm_comparator);
+
+		if (tbm->npacked > 0)
+		{
+			HASH_SEQ_STATUS status;
+			PackedEntry *pe;
+			int			npacked = 0;
+
+			if (!tbm->spacked)
+				tbm->spacked = (PackedEntry **)
+					MemoryContextAlloc(tbm->mcxt,
+									   tbm->npacked * sizeof(PackedEntry *));
+			hash_seq_init(&status, tbm->packtable);
+			while ((pe = (PackedEntry *) hash_seq_search(&status)) != NULL)
+				tbm->spacked[npacked++] = pe;
+			Assert(npacked == tbm->npacked);
+			if (npacked > 1)
+				qsort(tbm->spacked, npacked, sizeof(PackedEntry *),
+					  tbm_packed_comparator);
+		}
 	}
 
 	tbm->iterating = true;
@@ -661,9 +948,19 @@ tbm_iterate(TBMIterator *iterator)
 {
 	TIDBitmap  *tbm = iterator->tbm;
 	TBMIterateResult *output = &(iterator->output);
+	BlockNumber packed_blockno = InvalidBlockNumber;
 
 	Assert(tbm->iterating);
 
+	/* Find the next packed page, if any */
+	if (iterator->spackedptr < tbm->npacked)
+	{
+		PackedEntry *pe = tbm->spacked[iterator->spackedptr];
+
+		packed_blockno = pe->blockno +
+			PACKED_PAGEOFF(pe->items[iterator->spackeditem]);
+	}
+
 	/*
 	 * If lossy chunk pages remain, make sure we've advanced schunkptr/
 	 * schunkbit to the next set bit.
@@ -693,8 +990,9 @@ tbm_iterate(TBMIterator *iterator)
 	}
 
 	/*
-	 * If both chunk and per-page data remain, must output the numerically
-	 * earlier page.
+	 * If several of chunk, per-page and packed data remain, must output the
+	 * numerically earliest page.  (InvalidBlockNumber sorts after all valid
+	 * block numbers.)
 	 */
 	if (iterator->schunkptr < tbm->nchunks)
 	{
@@ -702,8 +1000,9 @@ tbm_iterate(TBMIterator *iterator)
 		BlockNumber chunk_blockno;
 
 		chunk_blockno = chunk->blockno + iterator->schunkbit;
-		if (iterator->spageptr >= tbm->npages ||
-			chunk_blockno < tbm->spages[iterator->spageptr]->blockno)
+		if ((iterator->spageptr >= tbm->npages ||
+			 chunk_blockno < tbm->spages[iterator->spageptr]->blockno) &&
+			chunk_blockno < packed_blockno)
 		{
 			/* Return a lossy page indicator from the chunk */
 			output->blockno = chunk_blockno;
@@ -717,8 +1016,6 @@ tbm_iterate(TBMIterator *iterator)
 	if (iterator->spageptr < tbm->npages)
 	{
 		PagetableEntry *page;
-		int			ntuples;
-		int			wordnum;
 
 		/* In ONE_PAGE state, we don't allocate an spages[] array */
 		if (tbm->status == TBM_ONE_PAGE)
@@ -726,29 +1023,38 @@ tbm_iterate(TBMIterator *iterator)
 		else
 			page = tbm->spages[iterator->spageptr];
 
-		/* scan bitmap to extract individual offset numbers */
-		ntuples = 0;
-		for (wordnum = 0; wordnum < WORDS_PER_PAGE; wordnum++)
+		if (page->blockno < packed_blockno)
 		{
-			bitmapword	w = page->words[wordnum];
+			output->blockno = page->blockno;
+			output->ntuples = tbm_extract_page_tuple(page->words, output);
+			output->recheck = page->recheck;
+			iterator->spageptr++;
+			return output;
+		}
+	}
 
-			if (w != 0)
-			{
-				int			off = wordnum * BITS_PER_BITMAPWORD + 1;
+	if (packed_blockno != InvalidBlockNumber)
+	{
+		PackedEntry *pe = tbm->spacked[iterator->spackedptr];
+		int			item = iterator->spackeditem;
+		int			pageoff = PACKED_PAGEOFF(pe->items[item]);
+		int			ntuples = 0;
+
+		/* copy out the page's offsets, which are in order already */
+		output->blockno = packed_blockno;
+		output->recheck = (pe->items[item] & TBM_PACKED_RECHECK) != 0;
+		while (item < pe->nitems && PACKED_PAGEOFF(pe->items[item]) == pageoff)
+			output->offsets[ntuples++] = PACKED_OFFSET(pe->items[item++]);
+		output->ntuples = ntuples;
 
-				while (w != 0)
-				{
-					if (w & 1)
-						output->offsets[ntuples++] = (OffsetNumber) off;
-					off++;
-					w >>= 1;
-				}
-			}
+		/* advance to next packed entry if we're done with this one */
+		if (item < pe->nitems)
+			iterator->spackeditem = item;
+		else
+		{
+			iterator->spackedptr++;
+			iterator->spackeditem = 0;
 		}
-		output->blockno = page->blockno;
-		output->ntuples = ntuples;
-		output->recheck = page->recheck;
-		iterator->spageptr++;
 		return output;
 	}
 
@@ -769,6 +1075,369 @@ tbm_end_iterate(TBMIterator *iterator)
 	pfree(iterator);
 }
 
+/*
+ * tbm_extract_page_tuple - extract the offsets of an exact page's tuples
+ *
+ * Stores them in output->offsets[], and returns their number.
+ */
+static int
+tbm_extract_page_tuple(const bitmapword *words, TBMIterateResult *output)
+{
+	int			ntuples = 0;
+	int			wordnum;
+
+	for (wordnum = 0; wordnum < WORDS_PER_PAGE; wordnum++)
+	{
+		bitmapword	w = words[wordnum];
+
+		if (w != 0)
+		{
+			int			off = wordnum * BITS_PER_BITMAPWORD + 1;
+
+			while (w != 0)
+			{
+				if (w & 1)
+					output->offsets[ntuples++] = (OffsetNumber) off;
+				off++;
+				w >>= 1;
+			}
+		}
+	}
+
+	return ntuples;
+}
+
+/*
+ * tbm_shared_estimate - space to reserve for a TBMSharedIteratorState
+ *
+ * ntuples is the expected number of TIDs in the bitmap, and maxbytes the
+ * memory limit it is built with.  In the worst case every TID is on a page
+ * of its own; allow for some misestimation beyond that, but there's no
+ * point in reserving more than the bitmap itself is allowed to use.
+ */
+Size
+tbm_shared_estimate(double ntuples, long maxbytes)
+{
+	double		nbytes;
+
+	if (ntuples <= 0.0)
+		ntuples = 1000.0;
+
+	nbytes = 2.0 * ntuples * TBM_SHARED_RECORD_SIZE(1);
+	nbytes = Min(nbytes, (double) maxbytes);
+
+	return add_size(MAXALIGN(sizeof(TBMSharedIteratorState)), (Size) nbytes);
+}
+
+/*
+ * tbm_shared_init - initialize an empty TBMSharedIteratorState
+ *
+ * size is the size of the space at state, as returned by
+ * tbm_shared_estimate().
+ */
+void
+tbm_shared_init(TBMSharedIteratorState *state, Size size)
+{
+	SpinLockInit(&state->mutex);
+	state->size = size - MAXALIGN(sizeof(TBMSharedIteratorState));
+	state->used = 0;
+	state->next = 0;
+	state->nextbit = 0;
+}
+
+/*
+ * tbm_shared_fill - copy a TIDBitmap into a TBMSharedIteratorState
+ *
+ * Returns false if the bitmap doesn't fit, in which case the shared state
+ * is left empty.  The state must not be iterated over until this is done;
+ * it's up to the caller to tell the other processes when that is.  Like
+ * tbm_begin_iterate(), this makes the bitmap read-only.
+ */
+bool
+tbm_shared_fill(TIDBitmap *tbm, TBMSharedIteratorState *state)
+{
+	TBMIterator *iterator;
+	int			spageptr = 0;
+	int			schunkptr = 0;
+	int			spackedptr = 0;
+	int			spackeditem = 0;
+	Size		used = 0;
+	bool		fits = true;
+
+	/* Make the sorted page lists */
+	iterator = tbm_begin_iterate(tbm);
+
+	for (;;)
+	{
+		PagetableEntry *page = NULL;
+		PagetableEntry *chunk = NULL;
+		PackedEntry *pe = NULL;
+		BlockNumber page_blockno = InvalidBlockNumber;
+		BlockNumber chunk_blockno = InvalidBlockNumber;
+		BlockNumber packed_blockno = InvalidBlockNumber;
+		Size		recsize;
+
+		if (spageptr < tbm->npages)
+		{
+			/* In ONE_PAGE state, we don't allocate an spages[] array */
+			if (tbm->status == TBM_ONE_PAGE)
+				page = &tbm->entry1;
+			else
+				page = tbm->spages[spageptr];
+			page_blockno = page->blockno;
+		}
+		if (schunkptr < tbm->nchunks)
+		{
+			chunk = tbm->schunks[schunkptr];
+			chunk_blockno = chunk->blockno;
+		}
+		if (spackedptr < tbm->npacked)
+		{
+			pe = tbm->spacked[spackedptr];
+			packed_blockno = pe->blockno +
+				PACKED_PAGEOFF(pe->items[spackeditem]);
+		}
+
+		if (chunk != NULL &&
+			chunk_blockno <= page_blockno && chunk_blockno <= packed_blockno)
+		{
+			recsize = tbm_shared_record(state, used, chunk_blockno,
+										TBM_SHARED_CHUNK, true,
+										chunk->words);
+			schunkptr++;
+		}
+		else if (page != NULL && page_blockno < packed_blockno)
+		{
+			OffsetNumber offsets[MAX_TUPLES_PER_PAGE];
+			int			ntuples = 0;
+			int			wordnum;
+
+			/* Store the offsets if that's smaller than the bitmap words */
+			for (wordnum = 0; wordnum < WORDS_PER_PAGE; wordnum++)
+			{
+				bitmapword	w = page->words[wordnum];
+				int			off = wordnum * BITS_PER_BITMAPWORD + 1;
+
+				for (; w != 0; w >>= 1, off++)
+				{
+					if (w & 1)
+						offsets[ntuples++] = (OffsetNumber) off;
+				}
+			}
+			if (ntuples * sizeof(OffsetNumber) <=
+				WORDS_PER_PAGE * sizeof(bitmapword))
+				recsize = tbm_shared_record(state, used, page_blockno,
+											ntuples, page->recheck,
+											offsets);
+			else
+				recsize = tbm_shared_record(state, used, page_blockno,
+											TBM_SHARED_WORDS, page->recheck,
+											page->words);
+			spageptr++;
+		}
+		else if (pe != NULL)
+		{
+			OffsetNumber offsets[MAX_PACKED_PER_PAGE];
+			int			pageoff = PACKED_PAGEOFF(pe->items[spackeditem]);
+			bool		recheck;
+			int			ntuples = 0;
+
+			recheck = (pe->items[spackeditem] & TBM_PACKED_RECHECK) != 0;
+			while (spackeditem < pe->nitems &&
+				   PACKED_PAGEOFF(pe->items[spackeditem]) == pageoff)
+				offsets[ntuples++] = PACKED_OFFSET(pe->items[spackeditem++]);
+			recsize = tbm_shared_record(state, used, packed_blockno,
+										ntuples, recheck, offsets);
+			if (spackeditem >= pe->nitems)
+			{
+				spackedptr++;
+				spackeditem = 0;
+			}
+		}
+		else
+			break;				/* all done */
+
+		if (recsize == 0)
+		{
+			fits = false;
+			used = 0;
+			break;
+		}
+		used += recsize;
+	}
+
+	tbm_end_iterate(iterator);
+
+	state->used = used;
+	state->next = 0;
+	state->nextbit = 0;
+
+	return fits;
+}
+
+/*
+ * tbm_shared_record - append a record to a TBMSharedIteratorState
+ *
+ * payload points to the offsets or bitmap words, according to ntuples.
+ * Returns the space taken up, or 0 if the record doesn't fit.
+ */
+static Size
+tbm_shared_record(TBMSharedIteratorState *state, Size offset,
+				  BlockNumber blockno, int ntuples, bool recheck,
+				  const void *payload)
+{
+	TBMSharedRecord *rec;
+	Size		payload_size = tbm_shared_payload_size(ntuples);
+	Size		recsize = TBM_SHARED_RECORD_SIZE(ntuples);
+
+	if (offset + recsize > state->size)
+		return 0;
+
+	rec = (TBMSharedRecord *) (TBM_SHARED_RECORDS(state) + offset);
+	rec->blockno = blockno;
+	rec->ntuples = ntuples;
+	rec->recheck = recheck;
+	memcpy(rec + 1, payload, payload_size);
+
+	return recsize;
+}
+
+/*
+ * tbm_shared_payload_size - size of the data following a record's header
+ */
+static Size
+tbm_shared_payload_size(int ntuples)
+{
+	if (ntuples == TBM_SHARED_WORDS)
+		return WORDS_PER_PAGE * sizeof(bitmapword);
+	else if (ntuples == TBM_SHARED_CHUNK)
+		return WORDS_PER_CHUNK * sizeof(bitmapword);
+	else
+		return ntuples * sizeof(OffsetNumber);
+}
+
+/*
+ * tbm_attach_shared_iterate - start taking pages from a shared bitmap
+ *
+ * The TBMSharedIteratorState must have been filled already.  Any number of
+ * processes can attach to it; each page is returned to only one of them.
+ */
+TBMSharedIterator *
+tbm_attach_shared_iterate(TBMSharedIteratorState *state)
+{
+	TBMSharedIterator *iterator;
+
+	iterator = (TBMSharedIterator *) palloc(sizeof(TBMSharedIterator) +
+								 MAX_TUPLES_PER_PAGE * sizeof(OffsetNumber));
+	iterator->state = state;
+
+	return iterator;
+}
+
+/*
+ * tbm_shared_iterate - take the next page of a shared bitmap
+ *
+ * Like tbm_iterate(), but pages are not strictly in numerical order, see
+ * above.
+ */
+TBMIterateResult *
+tbm_shared_iterate(TBMSharedIterator *iterator)
+{
+	TBMSharedIteratorState *state = iterator->state;
+	TBMIterateResult *output = &(iterator->output);
+	const TBMSharedRecord *rec = NULL;
+	int			bit = 0;
+
+	/*
+	 * Claim the next page.  Only finding the next page of a lossy chunk
+	 * takes any work under the spinlock; it's bounded by the chunk size.
+	 */
+	SpinLockAcquire(&state->mutex);
+	while (state->next < state->used)
+	{
+		const TBMSharedRecord *cur;
+
+		cur = (TBMSharedRecord *) (TBM_SHARED_RECORDS(state) + state->next);
+		if (cur->ntuples != TBM_SHARED_CHUNK)
+		{
+			rec = cur;
+			state->next += TBM_SHARED_RECORD_SIZE(cur->ntuples);
+			break;
+		}
+		else
+		{
+			const bitmapword *words = (const bitmapword *) (cur + 1);
+			int			nextbit = state->nextbit;
+
+			while (nextbit < PAGES_PER_CHUNK)
+			{
+				bitmapword	w = words[WORDNUM(nextbit)] >> BITNUM(nextbit);
+
+				if (w == 0)
+				{
+					/* nothing more in this word */
+					nextbit = (WORDNUM(nextbit) + 1) * BITS_PER_BITMAPWORD;
+					continue;
+				}
+				if (w & 1)
+					break;
+				nextbit++;
+			}
+			if (nextbit < PAGES_PER_CHUNK)
+			{
+				rec = cur;
+				bit = nextbit;
+				state->nextbit = nextbit + 1;
+				break;
+			}
+			/* advance to next record */
+			state->next += TBM_SHARED_RECORD_SIZE(cur->ntuples);
+			state->nextbit = 0;
+		}
+	}
+	SpinLockRelease(&state->mutex);
+
+	if (rec == NULL)
+		return NULL;			/* nothing more in the bitmap */
+
+	/* The record itself is read-only, so we can decode it without a lock */
+	if (rec->ntuples == TBM_SHARED_CHUNK)
+	{
+		output->blockno = rec->blockno + bit;
+		output->ntuples = -1;
+		output->recheck = true;
+	}
+	else if (rec->ntuples == TBM_SHARED_WORDS)
+	{
+		output->blockno = rec->blockno;
+		output->ntuples = tbm_extract_page_tuple((const bitmapword *) (rec + 1),
+												 output);
+		output->recheck = rec->recheck;
+	}
+	else
+	{
+		output->blockno = rec->blockno;
+		output->ntuples = rec->ntuples;
+		output->recheck = rec->recheck;
+		memcpy(output->offsets, rec + 1,
+			   rec->ntuples * sizeof(OffsetNumber));
+	}
+
+	return output;
+}
+
+/*
+ * tbm_end_shared_iterate - finish taking pages from a shared bitmap
+ *
+ * This only releases the process-local iterator; the shared state stays
+ * as it is.
+ */
+void
+tbm_end_shared_iterate(TBMSharedIterator *iterator)
+{
+	pfree(iterator);
+}
+
 /*
  * tbm_find_pageentry - find a PagetableEntry for the pageno
  *
@@ -791,9 +1460,7 @@ tbm_find_pageentry(const TIDBitmap *tbm, BlockNumber pageno)
 		return page;
 	}
 
-	page = (PagetableEntry *) hash_search(tbm->pagetable,
-										  (void *) &pageno,
-										  HASH_FIND, NULL);
+	page = pagetable_lookup(tbm->pagetable, pageno);
 	if (page == NULL)
 		return NULL;
 	if (page->ischunk)
@@ -834,19 +1501,35 @@ tbm_get_pageentry(TIDBitmap *tbm, BlockNumber pageno)
 		}
 
 		/* Look up or create an entry */
-		page = (PagetableEntry *) hash_search(tbm->pagetable,
-											  (void *) &pageno,
-											  HASH_ENTER, &found);
+		page = pagetable_insert(tbm->pagetable, pageno, &found);
 	}
 
 	/* Initialize it if not present before */
 	if (!found)
 	{
+		char		oldstatus = page->status;
+
 		MemSet(page, 0, sizeof(PagetableEntry));
+		page->status = oldstatus;
 		page->blockno = pageno;
 		/* must count it too */
 		tbm->nentries++;
 		tbm->npages++;
+		/* if the page was packed, it is exact from now on */
+		if (tbm->npacked > 0)
+			(void) tbm_take_packed_page(tbm, pageno, page->words,
+										&page->recheck);
+	}
+	else if (page->ischunk && tbm->npacked > 0)
+	{
+		/*
+		 * The caller is going to mark the chunk's own page lossy, so it
+		 * mustn't stay packed.
+		 */
+		bitmapword	words[WORDS_PER_PAGE];
+		bool		recheck;
+
+		(void) tbm_take_packed_page(tbm, pageno, words, &recheck);
 	}
 
 	return page;
@@ -869,9 +1552,7 @@ tbm_page_is_lossy(const TIDBitmap *tbm, BlockNumber pageno)
 
 	bitno = pageno % PAGES_PER_CHUNK;
 	chunk_pageno = pageno - bitno;
-	page = (PagetableEntry *) hash_search(tbm->pagetable,
-										  (void *) &chunk_pageno,
-										  HASH_FIND, NULL);
+	page = pagetable_lookup(tbm->pagetable, chunk_pageno);
 	if (page != NULL && page->ischunk)
 	{
 		int			wordnum = WORDNUM(bitno);
@@ -906,15 +1587,22 @@ tbm_mark_page_lossy(TIDBitmap *tbm, BlockNumber pageno)
 	bitno = pageno % PAGES_PER_CHUNK;
 	chunk_pageno = pageno - bitno;
 
+	/* Remove any packed tuples for the page */
+	if (tbm->npacked > 0)
+	{
+		bitmapword	words[WORDS_PER_PAGE];
+		bool		recheck;
+
+		(void) tbm_take_packed_page(tbm, pageno, words, &recheck);
+	}
+
 	/*
 	 * Remove any extant non-lossy entry for the page.  If the page is its own
 	 * chunk header, however, we skip this and handle the case below.
 	 */
 	if (bitno != 0)
 	{
-		if (hash_search(tbm->pagetable,
-						(void *) &pageno,
-						HASH_REMOVE, NULL) != NULL)
+		if (pagetable_delete(tbm->pagetable, pageno))
 		{
 			/* It was present, so adjust counts */
 			tbm->nentries--;
@@ -923,14 +1611,15 @@ tbm_mark_page_lossy(TIDBitmap *tbm, BlockNumber pageno)
 	}
 
 	/* Look up or create entry for chunk-header page */
-	page = (PagetableEntry *) hash_search(tbm->pagetable,
-										  (void *) &chunk_pageno,
-										  HASH_ENTER, &found);
+	page = pagetable_insert(tbm->pagetable, chunk_pageno, &found);
 
 	/* Initialize it if not present before */
 	if (!found)
 	{
+		char		oldstatus = page->status;
+
 		MemSet(page, 0, sizeof(PagetableEntry));
+		page->status = oldstatus;
 		page->blockno = chunk_pageno;
 		page->ischunk = true;
 		/* must count it too */
@@ -939,8 +1628,11 @@ tbm_mark_page_lossy(TIDBitmap *tbm, BlockNumber pageno)
 	}
 	else if (!page->ischunk)
 	{
+		char		oldstatus = page->status;
+
 		/* chunk header page was formerly non-lossy, make it lossy */
 		MemSet(page, 0, sizeof(PagetableEntry));
+		page->status = oldstatus;
 		page->blockno = chunk_pageno;
 		page->ischunk = true;
 		/* we assume it had some tuple bit(s) set, so mark it lossy */
@@ -962,9 +1654,14 @@ tbm_mark_page_lossy(TIDBitmap *tbm, BlockNumber pageno)
 static void
 tbm_lossify(TIDBitmap *tbm)
 {
-	HASH_SEQ_STATUS status;
+	pagetable_iterator i;
 	PagetableEntry *page;
 
+	/* Pack sparse pages first; that may be enough to make room */
+	tbm_compress(tbm);
+	if (TBM_USED_ENTRIES(tbm) <= tbm->maxentries / 2)
+		return;
+
 	/*
 	 * XXX Really stupid implementation: this just lossifies pages in
 	 * essentially random order.  We should be paying some attention to the
@@ -977,8 +1674,8 @@ tbm_lossify(TIDBitmap *tbm)
 	Assert(!tbm->iterating);
 	Assert(tbm->status == TBM_HASH);
 
-	hash_seq_init(&status, tbm->pagetable);
-	while ((page = (PagetableEntry *) hash_seq_search(&status)) != NULL)
+	pagetable_start_iterate(tbm->pagetable, &i);
+	while ((page = pagetable_iterate(tbm->pagetable, &i)) != NULL)
 	{
 		if (page->ischunk)
 			continue;			/* already a chunk header */
@@ -993,20 +1690,52 @@ tbm_lossify(TIDBitmap *tbm)
 		/* This does the dirty work ... */
 		tbm_mark_page_lossy(tbm, page->blockno);
 
-		if (tbm->nentries <= tbm->maxentries / 2)
+		if (TBM_USED_ENTRIES(tbm) <= tbm->maxentries / 2)
 		{
 			/* we have done enough */
-			hash_seq_term(&status);
-			break;
+			return;
 		}
 
 		/*
 		 * Note: tbm_mark_page_lossy may have inserted a lossy chunk into the
-		 * hashtable.  We can continue the same seq_search scan since we do
-		 * not care whether we visit lossy chunks or not.
+		 * hashtable, after removing the current page from it.  That can't
+		 * make the hashtable grow, so we can continue the same scan, since
+		 * we do not care whether we visit lossy chunks or not.
 		 */
 	}
 
+	/*
+	 * Still not enough, so lossify packed pages too, a whole page range at a
+	 * time.  tbm_mark_page_lossy removes each page's tuples from the entry,
+	 * and the entry itself along with the last of them.
+	 */
+	if (tbm->npacked > 0)
+	{
+		HASH_SEQ_STATUS status;
+		PackedEntry *pe;
+
+		hash_seq_init(&status, tbm->packtable);
+		while ((pe = (PackedEntry *) hash_seq_search(&status)) != NULL)
+		{
+			BlockNumber chunk_pageno = pe->blockno;
+			bool		last;
+
+			do
+			{
+				int			pageoff = PACKED_PAGEOFF(pe->items[0]);
+
+				last = (PACKED_PAGEOFF(pe->items[pe->nitems - 1]) == pageoff);
+				tbm_mark_page_lossy(tbm, chunk_pageno + pageoff);
+			} while (!last);
+
+			if (TBM_USED_ENTRIES(tbm) <= tbm->maxentries / 2)
+			{
+				hash_seq_term(&status);
+				return;
+			}
+		}
+	}
+
 	/*
 	 * With a big bitmap and small work_mem, it's possible that we cannot get
 	 * under maxentries.  Again, if that happens, we'd end up uselessly
@@ -1017,8 +1746,347 @@ tbm_lossify(TIDBitmap *tbm)
 	 * we broke out of the loop early; and if we didn't, the current number of
 	 * entries is simply not reducible any further.
 	 */
-	if (tbm->nentries > tbm->maxentries / 2)
-		tbm->maxentries = Min(tbm->nentries, (INT_MAX - 1) / 2) * 2;
+	if (TBM_USED_ENTRIES(tbm) > tbm->maxentries / 2)
+		tbm->maxentries = Min(TBM_USED_ENTRIES(tbm), (INT_MAX - 1) / 2) * 2;
+}
+
+/*
+ * tbm_compress - pack sparse exact pages to save space
+ *
+ * Like tbm_lossify, we shoot for getting down to maxentries/2.
+ */
+static void
+tbm_compress(TIDBitmap *tbm)
+{
+	pagetable_iterator i;
+	PagetableEntry *page;
+
+	Assert(!tbm->iterating);
+	Assert(tbm->status == TBM_HASH);
+
+	pagetable_start_iterate(tbm->pagetable, &i);
+	while ((page = pagetable_iterate(tbm->pagetable, &i)) != NULL)
+	{
+		BlockNumber pageno;
+		bitmapword	words[WORDS_PER_PAGE];
+		bool		recheck;
+		int			ntuples = 0;
+		int			wordnum;
+
+		if (page->ischunk)
+			continue;
+
+		for (wordnum = 0; wordnum < WORDS_PER_PAGE; wordnum++)
+		{
+			bitmapword	w = page->words[wordnum];
+
+			while (w != 0)
+			{
+				ntuples++;
+				w &= w - 1;
+			}
+		}
+		if (ntuples > MAX_PACKED_PER_PAGE)
+			continue;
+
+		/* Move the page over from the pagetable */
+		pageno = page->blockno;
+		memcpy(words, page->words, sizeof(words));
+		recheck = page->recheck;
+		pagetable_delete_item(tbm->pagetable, page);
+		tbm->nentries--;
+		tbm->npages--;
+		tbm_add_packed_page(tbm, pageno, words, recheck);
+
+		if (TBM_USED_ENTRIES(tbm) <= tbm->maxentries / 2)
+		{
+			/* we have done enough */
+			break;
+		}
+	}
+}
+
+/*
+ * tbm_page_words - get the tuple bitmap of an exact or packed page
+ *
+ * Returns false if the page is neither; words[] and *recheck are then
+ * unspecified.
+ */
+static bool
+tbm_page_words(const TIDBitmap *tbm, BlockNumber pageno,
+			   bitmapword *words, bool *recheck)
+{
+	const PagetableEntry *page;
+	const PackedEntry *pe;
+	int			start,
+				end;
+
+	page = tbm_find_pageentry(tbm, pageno);
+	if (page != NULL)
+	{
+		memcpy(words, page->words, WORDS_PER_PAGE * sizeof(bitmapword));
+		*recheck = page->recheck;
+		return true;
+	}
+
+	pe = tbm_find_packed(tbm, pageno);
+	if (pe == NULL)
+		return false;
+	tbm_packed_range(pe, pageno % PAGES_PER_CHUNK, &start, &end);
+	if (start == end)
+		return false;
+	MemSet(words, 0, WORDS_PER_PAGE * sizeof(bitmapword));
+	*recheck = false;
+	tbm_packed_words(pe, start, end, words, recheck);
+	return true;
+}
+
+/*
+ * tbm_find_packed - find the PackedEntry for pageno's page range, if any
+ */
+static PackedEntry *
+tbm_find_packed(const TIDBitmap *tbm, BlockNumber pageno)
+{
+	BlockNumber chunk_pageno = pageno - pageno % PAGES_PER_CHUNK;
+
+	if (tbm->npacked == 0)
+		return NULL;
+	return (PackedEntry *) hash_search(tbm->packtable,
+									   (void *) &chunk_pageno,
+									   HASH_FIND, NULL);
+}
+
+/*
+ * tbm_packed_range - locate the items of one page in a PackedEntry
+ *
+ * On return, items[*start .. *end - 1] are those of the page at position
+ * pageoff in the entry's range.  If there are none, *start == *end is where
+ * they would go.
+ */
+static void
+tbm_packed_range(const PackedEntry *pe, int pageoff, int *start, int *end)
+{
+	uint32		key = PACKED_ITEM(pageoff, 0);
+	int			lo = 0;
+	int			hi = pe->nitems;
+
+	while (lo < hi)
+	{
+		int			mid = (lo + hi) / 2;
+
+		if (pe->items[mid] < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	*start = lo;
+
+	while (lo < pe->nitems && PACKED_PAGEOFF(pe->items[lo]) == pageoff)
+		lo++;
+	*end = lo;
+}
+
+/*
+ * tbm_packed_words - OR packed items[start .. end - 1] into a page bitmap
+ */
+static void
+tbm_packed_words(const PackedEntry *pe, int start, int end,
+				 bitmapword *words, bool *recheck)
+{
+	int			i;
+
+	for (i = start; i < end; i++)
+	{
+		int			bitno = PACKED_OFFSET(pe->items[i]) - 1;
+
+		words[WORDNUM(bitno)] |= ((bitmapword) 1 << BITNUM(bitno));
+	}
+	if (start < end && (pe->items[start] & TBM_PACKED_RECHECK) != 0)
+		*recheck = true;
+}
+
+/*
+ * tbm_delete_packed - remove items[start .. end - 1] from a PackedEntry
+ *
+ * The entry itself goes away if that leaves it empty.
+ */
+static void
+tbm_delete_packed(TIDBitmap *tbm, PackedEntry *pe, int start, int end)
+{
+	memmove(&pe->items[start], &pe->items[end],
+			(pe->nitems - end) * sizeof(uint32));
+	pe->nitems -= end - start;
+
+	if (pe->nitems == 0)
+	{
+		BlockNumber chunk_pageno = pe->blockno;
+
+		pfree(pe->items);
+		tbm->packedbytes -= pe->maxitems * sizeof(uint32);
+		if (hash_search(tbm->packtable, (void *) &chunk_pageno,
+						HASH_REMOVE, NULL) == NULL)
+			elog(ERROR, "hash table corrupted");
+		tbm->npacked--;
+	}
+}
+
+/*
+ * tbm_take_packed_page - remove a page from packed storage
+ *
+ * The page's tuples are ORed into words[], and its recheck flag into
+ * *recheck.  Returns false, changing nothing, if the page isn't packed.
+ */
+static bool
+tbm_take_packed_page(TIDBitmap *tbm, BlockNumber pageno,
+					 bitmapword *words, bool *recheck)
+{
+	PackedEntry *pe;
+	int			start,
+				end;
+
+	pe = tbm_find_packed(tbm, pageno);
+	if (pe == NULL)
+		return false;
+	tbm_packed_range(pe, pageno % PAGES_PER_CHUNK, &start, &end);
+	if (start == end)
+		return false;
+	tbm_packed_words(pe, start, end, words, recheck);
+	tbm_delete_packed(tbm, pe, start, end);
+	return true;
+}
+
+/*
+ * tbm_add_packed_page - add tuples of a page to packed storage
+ *
+ * The page must be neither exact nor lossy in tbm, but may have packed
+ * tuples already, which are merged with the new ones.  If the page ends up
+ * with too many tuples to be worth packing, it is made exact instead.
+ *
+ * This may cause the table to exceed the desired memory size.  It is
+ * up to the caller to call tbm_lossify() at the next safe point if so.
+ */
+static void
+tbm_add_packed_page(TIDBitmap *tbm, BlockNumber pageno,
+					const bitmapword *words, bool recheck)
+{
+	BlockNumber chunk_pageno = pageno - pageno % PAGES_PER_CHUNK;
+	int			pageoff = pageno % PAGES_PER_CHUNK;
+	bitmapword	merged[WORDS_PER_PAGE];
+	PackedEntry *pe;
+	bool		found;
+	uint32		flag;
+	int			start,
+				end,
+				ntuples,
+				wordnum,
+				i;
+
+	Assert(tbm->status == TBM_HASH);
+
+	if (tbm->packtable == NULL)
+	{
+		HASHCTL		hash_ctl;
+
+		MemSet(&hash_ctl, 0, sizeof(hash_ctl));
+		hash_ctl.keysize = sizeof(BlockNumber);
+		hash_ctl.entrysize = sizeof(PackedEntry);
+		hash_ctl.hcxt = tbm->mcxt;
+		tbm->packtable = hash_create("TIDBitmap packed pages",
+									 128,	/* start small and extend */
+									 &hash_ctl,
+									 HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+
+	pe = (PackedEntry *) hash_search(tbm->packtable,
+									 (void *) &chunk_pageno,
+									 HASH_ENTER, &found);
+	if (!found)
+	{
+		pe->nitems = 0;
+		pe->maxitems = 0;
+		pe->items = NULL;
+		tbm->npacked++;
+	}
+
+	/* Merge with the page's existing items, if any */
+	memcpy(merged, words, sizeof(merged));
+	tbm_packed_range(pe, pageoff, &start, &end);
+	tbm_packed_words(pe, start, end, merged, &recheck);
+
+	ntuples = 0;
+	for (wordnum = 0; wordnum < WORDS_PER_PAGE; wordnum++)
+	{
+		bitmapword	w = merged[wordnum];
+
+		while (w != 0)
+		{
+			ntuples++;
+			w &= w - 1;
+		}
+	}
+
+	if (ntuples > MAX_PACKED_PER_PAGE || ntuples == 0)
+	{
+		PagetableEntry *page;
+
+		/* Remove the old items; this deletes pe too, if they were all */
+		if (start < end || pe->nitems == 0)
+			tbm_delete_packed(tbm, pe, start, end);
+		if (ntuples == 0)
+			return;
+
+		page = tbm_get_pageentry(tbm, pageno);
+		if (page->ischunk)
+		{
+			/* The page is a lossy chunk header, set bit for itself */
+			page->words[0] |= ((bitmapword) 1 << 0);
+		}
+		else
+		{
+			for (wordnum = 0; wordnum < WORDS_PER_PAGE; wordnum++)
+				page->words[wordnum] |= merged[wordnum];
+			page->recheck |= recheck;
+		}
+		return;
+	}
+
+	/* Make room for the page's new set of items */
+	if (pe->nitems - (end - start) + ntuples > pe->maxitems)
+	{
+		int			newmax = Max(pe->maxitems * 2, 16);
+
+		while (newmax < pe->nitems - (end - start) + ntuples)
+			newmax *= 2;
+		if (pe->items == NULL)
+			pe->items = (uint32 *)
+				MemoryContextAlloc(tbm->mcxt, newmax * sizeof(uint32));
+		else
+			pe->items = (uint32 *)
+				repalloc(pe->items, newmax * sizeof(uint32));
+		tbm->packedbytes += (newmax - pe->maxitems) * sizeof(uint32);
+		pe->maxitems = newmax;
+	}
+	memmove(&pe->items[start + ntuples], &pe->items[end],
+			(pe->nitems - end) * sizeof(uint32));
+	pe->nitems += ntuples - (end - start);
+
+	/* Fill in the page's items in offset order */
+	flag = recheck ? TBM_PACKED_RECHECK : 0;
+	i = start;
+	for (wordnum = 0; wordnum < WORDS_PER_PAGE; wordnum++)
+	{
+		bitmapword	w = merged[wordnum];
+		int			off = wordnum * BITS_PER_BITMAPWORD + 1;
+
+		while (w != 0)
+		{
+			if (w & 1)
+				pe->items[i++] = PACKED_ITEM(pageoff, off) | flag;
+			off++;
+			w >>= 1;
+		}
+	}
+	Assert(i == start + ntuples);
 }
 
 /*
@@ -1036,3 +2104,19 @@ tbm_comparator(const void *left, const void *right)
 		return 1;
 	return 0;
 }
+
+/*
+ * qsort comparator to handle PackedEntry pointers.
+ */
+static int
+tbm_packed_comparator(const void *left, const void *right)
+{
+	BlockNumber l = (*((PackedEntry *const *) left))->blockno;
+	BlockNumber r = (*((PackedEntry *const *) right))->blockno;
+
+	if (l < r)
+		return -1;
+	else if (l > r)
+		return 1;
+	return 0;
+}
@@ -266,7 +266,8 @@ merge_clump(PlannerInfo *root, List *clumps, Clump *new_clump, bool force)
 			/* Keep searching if join order is not valid */
 			if (joinrel)
 			{
-				/* Find and save the cheapest paths for this joinrel */
+				/* Gather any partial paths, then find the cheapest paths */
+				generate_gather_paths(root, joinrel);
 				set_cheapest(joinrel);
 
 				/* Absorb new clump into old */
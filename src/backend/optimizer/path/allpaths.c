@@ -29,6 +29,7 @@
 #include "optimizer/clauses.h"
 #include "optimizer/cost.h"
 #include "optimizer/geqo.h"
+#include "optimizer/joininfo.h"
 #include "optimizer/pathnode.h"
 #include "optimizer/paths.h"
 #include "optimizer/plancat.h"
@@ -53,6 +54,7 @@ typedef struct pushdown_safety_info
 /* These parameters are set by GUC */
 bool		enable_geqo = false;	/* just in case GUC doesn't set it */
 int			geqo_threshold;
+int			geqo_strategy = GEQO_STRATEGY_GENETIC;
 
 /* Hook for plugins to get control in set_rel_pathlist() */
 set_rel_pathlist_hook_type set_rel_pathlist_hook = NULL;
@@ -70,8 +72,11 @@ static void set_rel_pathlist(PlannerInfo *root, RelOptInfo *rel,
 				 Index rti, RangeTblEntry *rte);
 static void set_plain_rel_size(PlannerInfo *root, RelOptInfo *rel,
 				   RangeTblEntry *rte);
+static void set_rel_consider_parallel(PlannerInfo *root, RelOptInfo *rel,
+						  RangeTblEntry *rte);
 static void set_plain_rel_pathlist(PlannerInfo *root, RelOptInfo *rel,
 					   RangeTblEntry *rte);
+static void create_parallel_paths(PlannerInfo *root, RelOptInfo *rel);
 static void set_tablesample_rel_size(PlannerInfo *root, RelOptInfo *rel,
 						 RangeTblEntry *rte);
 static void set_tablesample_rel_pathlist(PlannerInfo *root, RelOptInfo *rel,
@@ -151,6 +156,9 @@ make_one_rel(PlannerInfo *root, List *joinlist)
 			continue;
 
 		root->all_baserels = bms_add_member(root->all_baserels, brel->relid);
+
+		/* Precompute the rels it has join clauses with, for join search */
+		set_base_rel_join_partners(root, brel);
 	}
 
 	/* Mark base rels as to whether we care about fast-start plans */
@@ -450,6 +458,66 @@ set_plain_rel_size(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte)
 
 	/* Mark rel with estimated output rows, width, etc */
 	set_baserel_size_estimates(root, rel);
+
+	/* Check whether the rel could be scanned by parallel workers */
+	if (root->glob->parallelModeOK)
+		set_rel_consider_parallel(root, rel, rte);
+}
+
+/*
+ * set_rel_consider_parallel
+ *	  Decide whether a plain relation could be scanned in parallel.
+ *
+ * For now, only plain permanent tables, and foreign tables whose FDW says
+ * it can scan them in parallel, are considered; and only if none of the
+ * expressions we'd have to evaluate in the workers is unsafe to run there.
+ */
+static void
+set_rel_consider_parallel(PlannerInfo *root, RelOptInfo *rel,
+						  RangeTblEntry *rte)
+{
+	ListCell   *lc;
+
+	/* This should only be called for plain, unsampled base relations. */
+	Assert(rel->reloptkind == RELOPT_BASEREL ||
+		   rel->reloptkind == RELOPT_OTHER_MEMBER_REL);
+	Assert(rte->rtekind == RTE_RELATION);
+	Assert(rte->tablesample == NULL);
+
+	/*
+	 * Workers can't access the leader's local buffers, so temporary tables
+	 * must be scanned by the leader alone.
+	 */
+	if (get_rel_persistence(rte->relid) == RELPERSISTENCE_TEMP)
+		return;
+
+	/* A foreign table can only be scanned in parallel if the FDW agrees. */
+	if (rte->relkind == RELKIND_FOREIGN_TABLE)
+	{
+		Assert(rel->fdwroutine != NULL);
+		if (rel->fdwroutine->IsForeignScanParallelSafe == NULL ||
+			!rel->fdwroutine->IsForeignScanParallelSafe(root, rel, rte))
+			return;
+	}
+
+	/*
+	 * The quals and output expressions must be safe to run in a worker.
+	 * Pseudoconstant quals are excluded too, since they'd require a gating
+	 * Result node underneath the Gather.
+	 */
+	foreach(lc, rel->baserestrictinfo)
+	{
+		RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+
+		if (rinfo->pseudoconstant ||
+			has_parallel_hazard((Node *) rinfo->clause, false))
+			return;
+	}
+	if (has_parallel_hazard((Node *) rel->reltargetlist, false))
+		return;
+
+	/* We have a winner. */
+	rel->consider_parallel = true;
 }
 
 /*
@@ -469,13 +537,103 @@ set_plain_rel_pathlist(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte)
 	required_outer = rel->lateral_relids;
 
 	/* Consider sequential scan */
-	add_path(rel, create_seqscan_path(root, rel, required_outer));
+	add_path(rel, create_seqscan_path(root, rel, required_outer, 0));
+
+	/* If appropriate, consider parallel sequential scan */
+	if (rel->consider_parallel && required_outer == NULL)
+		create_parallel_paths(root, rel);
 
 	/* Consider index scans */
 	create_index_paths(root, rel);
 
 	/* Consider TID scans */
 	create_tidscan_paths(root, rel);
+
+	/* Put a Gather node on top of the best partial path, if there is one */
+	generate_gather_paths(root, rel);
+}
+
+/*
+ * create_parallel_paths
+ *	  Build parallel sequential scan paths for a plain relation
+ */
+static void
+create_parallel_paths(PlannerInfo *root, RelOptInfo *rel)
+{
+	int			parallel_degree = compute_parallel_degree(rel);
+	Path	   *partial_path;
+
+	if (parallel_degree == 0)
+		return;
+
+	/*
+	 * Add an unordered partial path based on a parallel sequential scan.  The
+	 * partial path is remembered separately so that joins above it can be
+	 * done in parallel too, and so that grouping_planner can push partial
+	 * aggregation below the Gather that set_plain_rel_pathlist puts on top
+	 * of the cheapest partial path.
+	 */
+	partial_path = create_seqscan_path(root, rel, NULL, parallel_degree);
+	add_partial_path(rel, partial_path);
+}
+
+/*
+ * compute_parallel_degree
+ *	  Choose the number of workers for a parallel scan of a plain relation,
+ *	  or return 0 if it's not worth scanning in parallel.
+ */
+int
+compute_parallel_degree(RelOptInfo *rel)
+{
+	int			parallel_threshold = 1000;
+	int			parallel_degree = 1;
+
+	/*
+	 * If this relation is too small to be worth a parallel scan, just return
+	 * without doing anything ... unless it's an inheritance child.  In that
+	 * case, we want to generate a parallel path here anyway.  It might not be
+	 * worthwhile just for this relation, but when combined with all of its
+	 * inheritance siblings it may well pay off.
+	 */
+	if (rel->pages < parallel_threshold &&
+		rel->reloptkind == RELOPT_BASEREL)
+		return 0;
+
+	/*
+	 * Limit the degree of parallelism logarithmically based on the size of the
+	 * relation.  This probably needs to be a good deal more sophisticated, but
+	 * we need something here for now.
+	 */
+	while (rel->pages > parallel_threshold * 3 &&
+		   parallel_degree < max_parallel_degree)
+	{
+		parallel_degree++;
+		parallel_threshold *= 3;
+		if (parallel_threshold >= PG_INT32_MAX / 3)
+			break;
+	}
+
+	return parallel_degree;
+}
+
+/*
+ * generate_gather_paths
+ *	  Add a Gather path collecting the output of the rel's cheapest partial
+ *	  path, if it has one, to its ordinary pathlist.
+ */
+void
+generate_gather_paths(PlannerInfo *root, RelOptInfo *rel)
+{
+	Path	   *partial_path;
+
+	if (rel->partial_pathlist == NIL)
+		return;
+
+	partial_path = (Path *) linitial(rel->partial_pathlist);
+
+	add_path(rel, (Path *)
+			 create_gather_path(root, rel, partial_path, NULL,
+								partial_path->parallel_degree));
 }
 
 /*
@@ -523,6 +681,10 @@ set_foreign_size(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte)
 	/* Mark rel with estimated output rows, width, etc */
 	set_foreign_size_estimates(root, rel);
 
+	/* Check whether the rel could be scanned by parallel workers */
+	if (root->glob->parallelModeOK)
+		set_rel_consider_parallel(root, rel, rte);
+
 	/* Let FDW adjust the size estimates, if it can */
 	rel->fdwroutine->GetForeignRelSize(root, rel, rte->relid);
 }
@@ -534,8 +696,15 @@ set_foreign_size(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte)
 static void
 set_foreign_pathlist(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte)
 {
-	/* Call the FDW's GetForeignPaths function to generate path(s) */
+	/*
+	 * Call the FDW's GetForeignPaths function to generate path(s).  If the
+	 * rel is marked consider_parallel, the FDW may also add partial paths
+	 * with add_partial_path.
+	 */
 	rel->fdwroutine->GetForeignPaths(root, rel, rte->relid);
+
+	/* Put a Gather node on top of the partial path, if there is one */
+	generate_gather_paths(root, rel);
 }
 
 /*
@@ -1652,7 +1821,8 @@ make_rel_from_joinlist(PlannerInfo *root, List *joinlist)
 	{
 		/*
 		 * Consider the different orders in which we could join the rels,
-		 * using a plugin, GEQO, or the regular join search code.
+		 * using a plugin, GEQO (genetic or greedy), or the regular join
+		 * search code.
 		 *
 		 * We put the initial_rels list into a PlannerInfo field because
 		 * has_legal_joinclause() needs to look at it (ugly :-().
@@ -1662,7 +1832,11 @@ make_rel_from_joinlist(PlannerInfo *root, List *joinlist)
 		if (join_search_hook)
 			return (*join_search_hook) (root, levels_needed, initial_rels);
 		else if (enable_geqo && levels_needed >= geqo_threshold)
+		{
+			if (geqo_strategy == GEQO_STRATEGY_GREEDY)
+				return greedy_join_search(root, levels_needed, initial_rels);
 			return geqo(root, levels_needed, initial_rels);
+		}
 		else
 			return standard_join_search(root, levels_needed, initial_rels);
 	}
@@ -1742,6 +1916,9 @@ standard_join_search(PlannerInfo *root, int levels_needed, List *initial_rels)
 		{
 			rel = (RelOptInfo *) lfirst(lc);
 
+			/* Put a Gather node on top of the rel's partial path, if any */
+			generate_gather_paths(root, rel);
+
 			/* Find and save the cheapest paths for this rel */
 			set_cheapest(rel);
 
@@ -1765,6 +1942,172 @@ standard_join_search(PlannerInfo *root, int levels_needed, List *initial_rels)
 	return rel;
 }
 
+/*
+ * greedy_join_search
+ *	  Find a join order by greedy operator ordering: keep joining the pair of
+ *	  current join trees whose join is estimated to produce the fewest rows,
+ *	  until just one tree is left.
+ *
+ * The joinrels built for pairs of trees are remembered for as long as both
+ * trees survive, so each round only needs to build the joins of the tree
+ * formed in the previous round with the others.  That makes this O(N^2) in
+ * joinrels built, against standard_join_search's exponential growth, and
+ * unlike geqo() it always gives the same answer for the same query.  Like
+ * gimme_tree(), we consider only joins having a join clause or join order
+ * restriction, unless none of those is legal.
+ *
+ * Greedy choices can leave us with no legal join at all, in much the same
+ * cases where gimme_tree() fails.  If that happens, we forget the joinrels
+ * built here and let geqo() have a go instead.
+ */
+#define GREEDY_PAIR_UNTRIED		0	/* pair not considered yet */
+#define GREEDY_PAIR_POSTPONED	1	/* no joinclause; joinrel not built */
+#define GREEDY_PAIR_BUILT		2	/* joinrel built, or found illegal */
+
+RelOptInfo *
+greedy_join_search(PlannerInfo *root, int levels_needed, List *initial_rels)
+{
+	int			nrels = levels_needed;
+	int			nclumps = nrels;
+	RelOptInfo **clumps;
+	RelOptInfo **joinrels;
+	char	   *pairstate;
+	int			savelength;
+	struct HTAB *savehash;
+	ListCell   *lc;
+	int			i;
+	int			j;
+
+	/*
+	 * clumps[] holds the join tree in each slot, or NULL once the slot has
+	 * been merged into another.  joinrels[] and pairstate[] are indexed by
+	 * i * nrels + j, for slots i < j.
+	 */
+	clumps = (RelOptInfo **) palloc(nrels * sizeof(RelOptInfo *));
+	i = 0;
+	foreach(lc, initial_rels)
+		clumps[i++] = (RelOptInfo *) lfirst(lc);
+	joinrels = (RelOptInfo **) palloc0(nrels * nrels * sizeof(RelOptInfo *));
+	pairstate = (char *) palloc0(nrels * nrels * sizeof(char));
+
+	/*
+	 * Make sure we can take back our additions to root->join_rel_list if we
+	 * must give up; see geqo_eval() for the details.
+	 */
+	savelength = list_length(root->join_rel_list);
+	savehash = root->join_rel_hash;
+	Assert(root->join_rel_level == NULL);
+
+	root->join_rel_hash = NULL;
+
+	while (nclumps > 1)
+	{
+		RelOptInfo *best = NULL;
+		int			best_i = -1;
+		int			best_j = -1;
+		bool		force = false;
+
+		for (;;)
+		{
+			for (i = 0; i < nrels; i++)
+			{
+				if (clumps[i] == NULL)
+					continue;
+
+				for (j = i + 1; j < nrels; j++)
+				{
+					int			pair = i * nrels + j;
+					RelOptInfo *joinrel;
+
+					if (clumps[j] == NULL)
+						continue;
+
+					if (pairstate[pair] == GREEDY_PAIR_UNTRIED ||
+						(force && pairstate[pair] == GREEDY_PAIR_POSTPONED))
+					{
+						if (force ||
+							have_relevant_joinclause(root,
+													 clumps[i], clumps[j]) ||
+							have_join_order_restriction(root,
+														clumps[i], clumps[j]))
+						{
+							joinrel = make_join_rel(root, clumps[i], clumps[j]);
+							if (joinrel)
+							{
+								generate_gather_paths(root, joinrel);
+								set_cheapest(joinrel);
+							}
+							joinrels[pair] = joinrel;
+							pairstate[pair] = GREEDY_PAIR_BUILT;
+						}
+						else
+							pairstate[pair] = GREEDY_PAIR_POSTPONED;
+					}
+
+					joinrel = joinrels[pair];
+					if (joinrel == NULL)
+						continue;
+
+					if (best == NULL ||
+						joinrel->rows < best->rows ||
+						(joinrel->rows == best->rows &&
+						 joinrel->cheapest_total_path->total_cost <
+						 best->cheapest_total_path->total_cost))
+					{
+						best = joinrel;
+						best_i = i;
+						best_j = j;
+					}
+				}
+			}
+
+			/* If no desirable join is legal, try cartesian products too */
+			if (best != NULL || force)
+				break;
+			force = true;
+		}
+
+		if (best == NULL)
+		{
+			root->join_rel_list = list_truncate(root->join_rel_list,
+												savelength);
+			root->join_rel_hash = savehash;
+
+			return geqo(root, levels_needed, initial_rels);
+		}
+
+		/* Replace the first tree with the join, and forget the second one */
+		clumps[best_i] = best;
+		clumps[best_j] = NULL;
+		nclumps--;
+
+		/* Pairs involving the first slot have to be considered afresh */
+		for (i = 0; i < nrels; i++)
+		{
+			int			pair;
+
+			if (i == best_i)
+				continue;
+			pair = (i < best_i) ? i * nrels + best_i : best_i * nrels + i;
+			joinrels[pair] = NULL;
+			pairstate[pair] = GREEDY_PAIR_UNTRIED;
+		}
+
+#ifdef OPTIMIZER_DEBUG
+		debug_print_rel(root, best);
+#endif
+	}
+
+	for (i = 0; i < nrels; i++)
+	{
+		if (clumps[i] != NULL)
+			return clumps[i];
+	}
+
+	elog(ERROR, "failed to join all relations together");
+	return NULL;				/* keep compiler quiet */
+}
+
 /*****************************************************************************
  *			PUSHING QUALS DOWN INTO SUBQUERIES
  *****************************************************************************/
@@ -2443,6 +2786,10 @@ print_path(PlannerInfo *root, Path *path, int indent)
 			ptype = "Material";
 			subpath = ((MaterialPath *) path)->subpath;
 			break;
+		case T_MemoizePath:
+			ptype = "Memoize";
+			subpath = ((MemoizePath *) path)->subpath;
+			break;
 		case T_UniquePath:
 			ptype = "Unique";
 			subpath = ((UniquePath *) path)->subpath;
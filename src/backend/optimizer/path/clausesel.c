@@ -41,6 +41,13 @@ typedef struct RangeQueryClause
 
 static void addRangeClause(RangeQueryClause **rqlist, Node *clause,
 			   bool varonleft, bool isLTsel, Selectivity s2);
+static Selectivity clauselist_index_group_selectivity(PlannerInfo *root,
+								   List *clauses,
+								   int varRelid,
+								   JoinType jointype,
+								   SpecialJoinInfo *sjinfo,
+								   Bitmapset **estimated);
+static bool is_var_eq_const_clause(Node *clause, Var **var);
 
 
 /****************************************************************************
@@ -61,8 +68,12 @@ static void addRangeClause(RangeQueryClause **rqlist, Node *clause,
  * subclauses.  However, that's only right if the subclauses have independent
  * probabilities, and in reality they are often NOT independent.  So,
  * we want to be smarter where we can.
-
- * Currently, the only extra smarts we have is to recognize "range queries",
+ *
+ * First, if there are equality conditions on several of the leading
+ * columns of an index, ANALYZE may have found how much the values of those
+ * columns depend on each other; see clauselist_index_group_selectivity.
+ *
+ * Other than that, the only extra smarts we have is to recognize "range queries",
  * such as "x > 34 AND x < 42".  Clauses are recognized as possible range
  * query components if they are restriction opclauses whose operators have
  * scalarltsel() or scalargtsel() as their restriction selectivity estimator.
@@ -98,7 +109,9 @@ clauselist_selectivity(PlannerInfo *root,
 {
 	Selectivity s1 = 1.0;
 	RangeQueryClause *rqlist = NULL;
+	Bitmapset  *estimated = NULL;
 	ListCell   *l;
+	int			listidx;
 
 	/*
 	 * If there's exactly one clause, then no use in trying to match up pairs,
@@ -108,17 +121,28 @@ clauselist_selectivity(PlannerInfo *root,
 		return clause_selectivity(root, (Node *) linitial(clauses),
 								  varRelid, jointype, sjinfo);
 
+	/* Estimate clauses on correlated index columns together */
+	s1 = clauselist_index_group_selectivity(root, clauses, varRelid,
+											jointype, sjinfo, &estimated);
+
 	/*
 	 * Initial scan over clauses.  Anything that doesn't look like a potential
 	 * rangequery clause gets multiplied into s1 and forgotten. Anything that
 	 * does gets inserted into an rqlist entry.
 	 */
+	listidx = -1;
 	foreach(l, clauses)
 	{
 		Node	   *clause = (Node *) lfirst(l);
 		RestrictInfo *rinfo;
 		Selectivity s2;
 
+		listidx++;
+
+		/* Skip clauses already accounted for above */
+		if (bms_is_member(listidx, estimated))
+			continue;
+
 		/* Always compute the selectivity using clause_selectivity */
 		s2 = clause_selectivity(root, clause, varRelid, jointype, sjinfo);
 
@@ -278,6 +302,196 @@ clauselist_selectivity(PlannerInfo *root,
 	return s1;
 }
 
+/*
+ * clauselist_index_group_selectivity
+ *		Estimate together the equality clauses on the leading columns of an
+ *		index, using what ANALYZE found about how those columns depend on
+ *		each other.
+ *
+ * For each base rel, we look for the index with the longest prefix of
+ * columns that all have a "Var = pseudoconstant" clause in the list, and for
+ * which there are statistics (see STATISTIC_KIND_DEPENDENCY).  Taking the
+ * columns one at a time, if column c is determined by the ones before it to
+ * degree d, then of the rows matching the clauses on the earlier columns,
+ * a fraction d match the clause on c if they can at all, and the rest match
+ * it independently:
+ *
+ *		P(earlier, c) = d * Min(P(earlier), P(c)) + (1 - d) * P(earlier) * P(c)
+ *
+ * Returns the product of the selectivities so estimated, and adds the list
+ * positions of the clauses used to *estimated, so the caller can skip them.
+ */
+static Selectivity
+clauselist_index_group_selectivity(PlannerInfo *root,
+								   List *clauses,
+								   int varRelid,
+								   JoinType jointype,
+								   SpecialJoinInfo *sjinfo,
+								   Bitmapset **estimated)
+{
+	Selectivity s1 = 1.0;
+	int			nclauses = list_length(clauses);
+	Var		  **vars;
+	Relids		varnos = NULL;
+	ListCell   *l;
+	int			listidx;
+	int			varno;
+
+	/* Find the clauses we might be able to use */
+	vars = (Var **) palloc0(nclauses * sizeof(Var *));
+	listidx = 0;
+	foreach(l, clauses)
+	{
+		Var		   *var;
+
+		if (is_var_eq_const_clause((Node *) lfirst(l), &var) &&
+			var->varno < root->simple_rel_array_size &&
+			root->simple_rel_array[var->varno] != NULL &&
+			root->simple_rel_array[var->varno]->indexlist != NIL)
+		{
+			vars[listidx] = var;
+			varnos = bms_add_member(varnos, var->varno);
+		}
+		listidx++;
+	}
+
+	/* Process each rel separately */
+	while ((varno = bms_first_member(varnos)) >= 0)
+	{
+		RelOptInfo *rel = root->simple_rel_array[varno];
+		int			matches[INDEX_MAX_KEYS];
+		int			bestmatches[INDEX_MAX_KEYS];
+		Selectivity bestdegrees[INDEX_MAX_KEYS];
+		int			bestncols = 0;
+
+		foreach(l, rel->indexlist)
+		{
+			IndexOptInfo *index = (IndexOptInfo *) lfirst(l);
+			Selectivity degrees[INDEX_MAX_KEYS];
+			int			ncols;
+			int			i;
+
+			if (index->indpred != NIL)
+				continue;
+
+			/* find how many of the leading index columns have clauses */
+			for (ncols = 0; ncols < index->nkeycolumns; ncols++)
+			{
+				matches[ncols] = -1;
+				if (index->indexkeys[ncols] == 0)
+					break;
+				for (listidx = 0; listidx < nclauses; listidx++)
+				{
+					if (vars[listidx] != NULL &&
+						vars[listidx]->varno == varno &&
+						vars[listidx]->varattno == index->indexkeys[ncols])
+					{
+						matches[ncols] = listidx;
+						break;
+					}
+				}
+				if (matches[ncols] < 0)
+					break;
+			}
+			if (ncols <= bestncols || ncols < 2)
+				continue;
+
+			/* and how many of those we have statistics for */
+			for (i = 1; i < ncols; i++)
+			{
+				double		ndistinct;
+
+				if (!get_index_group_stats(index->indexoid, i + 1,
+										   &ndistinct, &degrees[i]))
+					break;
+			}
+			if (i > bestncols && i >= 2)
+			{
+				bestncols = i;
+				memcpy(bestmatches, matches, i * sizeof(int));
+				memcpy(bestdegrees, degrees, i * sizeof(Selectivity));
+			}
+		}
+
+		if (bestncols >= 2)
+		{
+			Selectivity s2;
+			int			i;
+
+			s2 = clause_selectivity(root,
+									(Node *) list_nth(clauses, bestmatches[0]),
+									varRelid, jointype, sjinfo);
+			*estimated = bms_add_member(*estimated, bestmatches[0]);
+
+			for (i = 1; i < bestncols; i++)
+			{
+				Selectivity s3;
+				Selectivity degree = bestdegrees[i];
+
+				s3 = clause_selectivity(root,
+									(Node *) list_nth(clauses, bestmatches[i]),
+										varRelid, jointype, sjinfo);
+				s2 = degree * Min(s2, s3) + (1.0 - degree) * s2 * s3;
+				*estimated = bms_add_member(*estimated, bestmatches[i]);
+			}
+
+			s1 *= s2;
+		}
+	}
+
+	pfree(vars);
+
+	return s1;
+}
+
+/*
+ * is_var_eq_const_clause
+ *		Is the clause of the form "Var = pseudoconstant", where "=" is an
+ *		operator estimated by eqsel, and the Var is a column of a base rel?
+ *
+ * If so, the Var is returned in *var.
+ */
+static bool
+is_var_eq_const_clause(Node *clause, Var **var)
+{
+	RestrictInfo *rinfo = NULL;
+	OpExpr	   *expr;
+	Node	   *leftop;
+	Node	   *rightop;
+
+	if (IsA(clause, RestrictInfo))
+	{
+		rinfo = (RestrictInfo *) clause;
+		if (rinfo->pseudoconstant)
+			return false;
+		clause = (Node *) rinfo->clause;
+	}
+
+	if (!is_opclause(clause) || list_length(((OpExpr *) clause)->args) != 2)
+		return false;
+	expr = (OpExpr *) clause;
+	if (get_oprrest(expr->opno) != F_EQSEL)
+		return false;
+
+	leftop = linitial(expr->args);
+	rightop = lsecond(expr->args);
+	if (leftop && IsA(leftop, RelabelType))
+		leftop = (Node *) ((RelabelType *) leftop)->arg;
+	if (rightop && IsA(rightop, RelabelType))
+		rightop = (Node *) ((RelabelType *) rightop)->arg;
+
+	if (leftop && IsA(leftop, Var) &&
+		is_pseudo_constant_clause(lsecond(expr->args)))
+		*var = (Var *) leftop;
+	else if (rightop && IsA(rightop, Var) &&
+			 is_pseudo_constant_clause(linitial(expr->args)))
+		*var = (Var *) rightop;
+	else
+		return false;
+
+	return (*var)->varlevelsup == 0 && (*var)->varattno > 0;
+}
+
 /*
  * addRangeClause --- add a new range clause for clauselist_selectivity
  *
@@ -11,6 +11,8 @@
  *	cpu_tuple_cost		Cost of typical CPU time to process a tuple
  *	cpu_index_tuple_cost  Cost of typical CPU time to process an index tuple
  *	cpu_operator_cost	Cost of CPU time to execute an operator or function
+ *	parallel_tuple_cost Cost of CPU time to pass a tuple from worker to master backend
+ *	parallel_setup_cost Cost of setting up shared memory for parallelism
  *
  * We expect that the kernel will typically do some amount of read-ahead
  * optimization; this in conjunction with seek costs means that seq_page_cost
@@ -101,22 +103,30 @@ double		random_page_cost = DEFAULT_RANDOM_PAGE_COST;
 double		cpu_tuple_cost = DEFAULT_CPU_TUPLE_COST;
 double		cpu_index_tuple_cost = DEFAULT_CPU_INDEX_TUPLE_COST;
 double		cpu_operator_cost = DEFAULT_CPU_OPERATOR_COST;
+double		parallel_tuple_cost = DEFAULT_PARALLEL_TUPLE_COST;
+double		parallel_setup_cost = DEFAULT_PARALLEL_SETUP_COST;
 
 int			effective_cache_size = DEFAULT_EFFECTIVE_CACHE_SIZE;
 
 Cost		disable_cost = 1.0e10;
 
+int			max_parallel_degree = 0;
+
 bool		enable_seqscan = true;
 bool		enable_indexscan = true;
 bool		enable_indexonlyscan = true;
 bool		enable_bitmapscan = true;
 bool		enable_tidscan = true;
 bool		enable_sort = true;
+bool		enable_incrementalsort = true;
 bool		enable_hashagg = true;
 bool		enable_nestloop = true;
 bool		enable_material = true;
+bool		enable_memoize = true;
 bool		enable_mergejoin = true;
 bool		enable_hashjoin = true;
+bool		enable_parallel_hash = true;
+bool		enable_partitionwise_aggregate = false;
 
 typedef struct
 {
@@ -128,6 +138,8 @@ static List *extract_nonindex_conditions(List *qual_clauses, List *indexquals);
 static MergeScanSelCache *cached_scansel(PlannerInfo *root,
 			   RestrictInfo *rinfo,
 			   PathKey *pathkey);
+static void cost_memoize_rescan(PlannerInfo *root, MemoizePath *mpath,
+					Cost *rescan_startup_cost, Cost *rescan_total_cost);
 static void cost_rescan(PlannerInfo *root, Path *path,
 			Cost *rescan_startup_cost, Cost *rescan_total_cost);
 static bool cost_qual_eval_walker(Node *node, cost_qual_eval_context *context);
@@ -180,7 +192,8 @@ cost_seqscan(Path *path, PlannerInfo *root,
 			 RelOptInfo *baserel, ParamPathInfo *param_info)
 {
 	Cost		startup_cost = 0;
-	Cost		run_cost = 0;
+	Cost		cpu_run_cost;
+	Cost		disk_run_cost;
 	double		spc_seq_page_cost;
 	QualCost	qpqual_cost;
 	Cost		cpu_per_tuple;
@@ -206,17 +219,56 @@ cost_seqscan(Path *path, PlannerInfo *root,
 	/*
 	 * disk costs
 	 */
-	run_cost += spc_seq_page_cost * baserel->pages;
+	disk_run_cost = spc_seq_page_cost * baserel->pages;
 
 	/* CPU costs */
 	get_restriction_qual_cost(root, baserel, param_info, &qpqual_cost);
 
 	startup_cost += qpqual_cost.startup;
 	cpu_per_tuple = cpu_tuple_cost + qpqual_cost.per_tuple;
-	run_cost += cpu_per_tuple * baserel->tuples;
+	cpu_run_cost = cpu_per_tuple * baserel->tuples;
+
+	/* Adjust costing for parallelism, if used. */
+	if (path->parallel_degree > 0)
+	{
+		double		parallel_divisor = get_parallel_divisor(path);
+
+		/*
+		 * In the case of a parallel plan, the row count needs to represent
+		 * the number of tuples processed per worker.  The disk cost isn't
+		 * divided up, since we assume that the I/O rather than CPU is the
+		 * bottleneck for reading pages.
+		 */
+		cpu_run_cost /= parallel_divisor;
+		path->rows = clamp_row_est(path->rows / parallel_divisor);
+	}
 
 	path->startup_cost = startup_cost;
-	path->total_cost = startup_cost + run_cost;
+	path->total_cost = startup_cost + cpu_run_cost + disk_run_cost;
+}
+
+/*
+ * get_parallel_divisor
+ *	  Estimate the fraction of the work that each participant in a parallel
+ *	  plan does, expressed as the number of participants' worth of work that
+ *	  gets done in parallel.
+ */
+double
+get_parallel_divisor(Path *path)
+{
+	double		parallel_divisor = path->parallel_degree;
+	double		leader_contribution;
+
+	/*
+	 * The leader also runs the plan, but spends some of its time reading
+	 * tuples from the workers; we guess that each worker costs it 30% of its
+	 * time.  With enough workers the leader contributes nothing.
+	 */
+	leader_contribution = 1.0 - (0.3 * path->parallel_degree);
+	if (leader_contribution > 0)
+		parallel_divisor += leader_contribution;
+
+	return parallel_divisor;
 }
 
 /*
@@ -286,6 +338,38 @@ cost_samplescan(Path *path, PlannerInfo *root, RelOptInfo *baserel)
 	path->total_cost = startup_cost + run_cost;
 }
 
+/*
+ * cost_gather
+ *	  Determines and returns the cost of gather path.
+ *
+ * 'rel' is the relation to be operated upon
+ * 'param_info' is the ParamPathInfo if this is a parameterized path, else NULL
+ */
+void
+cost_gather(GatherPath *path, PlannerInfo *root,
+			RelOptInfo *rel, ParamPathInfo *param_info)
+{
+	Cost		startup_cost = 0;
+	Cost		run_cost = 0;
+
+	/* Mark the path with the correct row estimate */
+	if (param_info)
+		path->path.rows = param_info->ppi_rows;
+	else
+		path->path.rows = rel->rows;
+
+	startup_cost = path->subpath->startup_cost;
+
+	run_cost = path->subpath->total_cost - path->subpath->startup_cost;
+
+	/* Parallel setup and communication cost. */
+	startup_cost += parallel_setup_cost;
+	run_cost += parallel_tuple_cost * path->path.rows;
+
+	path->path.startup_cost = startup_cost;
+	path->path.total_cost = (startup_cost + run_cost);
+}
+
 /*
  * cost_index
  *	  Determines and returns the cost of scanning a relation using an index.
@@ -324,6 +408,7 @@ cost_index(IndexPath *path, PlannerInfo *root, double loop_count)
 				max_IO_cost;
 	QualCost	qpqual_cost;
 	Cost		cpu_per_tuple;
+	Cost		cpu_run_cost;
 	double		tuples_fetched;
 	double		pages_fetched;
 
@@ -515,7 +600,19 @@ cost_index(IndexPath *path, PlannerInfo *root, double loop_count)
 	startup_cost += qpqual_cost.startup;
 	cpu_per_tuple = cpu_tuple_cost + qpqual_cost.per_tuple;
 
-	run_cost += cpu_per_tuple * tuples_fetched;
+	cpu_run_cost = cpu_per_tuple * tuples_fetched;
+
+	/* Adjust costing for parallelism, if used. */
+	if (path->path.parallel_degree > 0)
+	{
+		double		parallel_divisor = get_parallel_divisor(&path->path);
+
+		/* As in cost_seqscan, divide up the CPU cost but not the I/O */
+		cpu_run_cost /= parallel_divisor;
+		path->path.rows = clamp_row_est(path->path.rows / parallel_divisor);
+	}
+
+	run_cost += cpu_run_cost;
 
 	path->path.startup_cost = startup_cost;
 	path->path.total_cost = startup_cost + run_cost;
@@ -725,6 +822,7 @@ cost_bitmap_heap_scan(Path *path, PlannerInfo *root, RelOptInfo *baserel,
 	Selectivity indexSelectivity;
 	QualCost	qpqual_cost;
 	Cost		cpu_per_tuple;
+	Cost		cpu_run_cost;
 	Cost		cost_per_page;
 	double		tuples_fetched;
 	double		pages_fetched;
@@ -824,7 +922,22 @@ cost_bitmap_heap_scan(Path *path, PlannerInfo *root, RelOptInfo *baserel,
 	startup_cost += qpqual_cost.startup;
 	cpu_per_tuple = cpu_tuple_cost + qpqual_cost.per_tuple;
 
-	run_cost += cpu_per_tuple * tuples_fetched;
+	cpu_run_cost = cpu_per_tuple * tuples_fetched;
+
+	/*
+	 * Adjust costing for parallelism, if used.  The bitmap is still built by
+	 * just one participant, so its cost stays in startup_cost.
+	 */
+	if (path->parallel_degree > 0)
+	{
+		double		parallel_divisor = get_parallel_divisor(path);
+
+		/* As in cost_seqscan, divide up the CPU cost but not the I/O */
+		cpu_run_cost /= parallel_divisor;
+		path->rows = clamp_row_est(path->rows / parallel_divisor);
+	}
+
+	run_cost += cpu_run_cost;
 
 	path->startup_cost = startup_cost;
 	path->total_cost = startup_cost + run_cost;
@@ -1307,8 +1420,8 @@ cost_recursive_union(Plan *runion, Plan *nrterm, Plan *rterm)
  * total, but we will also need to write and read each tuple once per
  * merge pass.  We expect about ceil(logM(r)) merge passes where r is the
  * number of initial runs formed and M is the merge order used by tuplesort.c.
- * Since the average initial run should be about twice sort_mem, we have
- *		disk traffic = 2 * relsize * ceil(logM(p / (2*sort_mem)))
+ * Since the average initial run should be about sort_mem, we have
+ *		disk traffic = 2 * relsize * ceil(logM(p / sort_mem))
  *		cpu = comparison_cost * t * log2(t)
  *
  * If the sort is bounded (i.e., only the first k result tuples are needed)
@@ -1384,7 +1497,7 @@ cost_sort(Path *path, PlannerInfo *root,
 		 * We'll have to use a disk-based sort of all the tuples
 		 */
 		double		npages = ceil(input_bytes / BLCKSZ);
-		double		nruns = (input_bytes / sort_mem_bytes) * 0.5;
+		double		nruns = input_bytes / sort_mem_bytes;
 		double		mergeorder = tuplesort_merge_order(sort_mem_bytes);
 		double		log_runs;
 		double		npageaccesses;
@@ -1438,6 +1551,101 @@ cost_sort(Path *path, PlannerInfo *root,
 	path->total_cost = startup_cost + run_cost;
 }
 
+/*
+ * cost_incremental_sort
+ *	  Determines and returns the cost of sorting a relation that is already
+ *	  sorted on the first presorted_keys of pathkeys, a group of tuples with
+ *	  equal values in those keys at a time.
+ *
+ * We estimate the number of groups from the presorted keys, and charge
+ * cost_sort's cost of sorting one average group for each group.  Only the
+ * first group has to be read and sorted before the first tuple can be
+ * returned, which is what makes this attractive under a LIMIT.  We also
+ * charge a comparison of the presorted keys per input tuple, to detect the
+ * group boundaries.
+ *
+ * The executor sorts at least a few dozen tuples at a time even when the
+ * groups are smaller than that, so we don't let the estimated group size
+ * drop below that either.
+ *
+ * Parameters are as for cost_sort, except that the input's startup and total
+ * costs are given separately.
+ */
+void
+cost_incremental_sort(Path *path, PlannerInfo *root,
+					  List *pathkeys, int presorted_keys,
+					  Cost input_startup_cost, Cost input_total_cost,
+					  double input_tuples, int width,
+					  Cost comparison_cost, int sort_mem,
+					  double limit_tuples)
+{
+	Cost		startup_cost;
+	Cost		run_cost;
+	Cost		input_run_cost = input_total_cost - input_startup_cost;
+	double		group_tuples;
+	double		input_groups;
+	Cost		group_input_run_cost;
+	List	   *presortedExprs = NIL;
+	ListCell   *l;
+	int			i = 0;
+	Path		sort_path;		/* dummy for result of cost_sort */
+
+	Assert(presorted_keys > 0 && presorted_keys < list_length(pathkeys));
+
+	if (input_tuples < 2.0)
+		input_tuples = 2.0;
+
+	/* Estimate the number of groups of tuples with equal presorted keys */
+	foreach(l, pathkeys)
+	{
+		PathKey    *key = (PathKey *) lfirst(l);
+		EquivalenceMember *member = (EquivalenceMember *)
+		linitial(key->pk_eclass->ec_members);
+
+		presortedExprs = lappend(presortedExprs, member->em_expr);
+		if (++i >= presorted_keys)
+			break;
+	}
+	input_groups = estimate_num_groups(root, presortedExprs, input_tuples,
+									   NULL);
+	list_free(presortedExprs);
+
+	group_tuples = input_tuples / input_groups;
+	if (group_tuples < 32.0)
+	{
+		group_tuples = Min(32.0, input_tuples);
+		input_groups = ceil(input_tuples / group_tuples);
+	}
+	group_input_run_cost = input_run_cost / input_groups;
+
+	/*
+	 * Estimate the cost of sorting one group.  A bound applies to the first
+	 * group only if it's big enough to satisfy it, so don't pass one along.
+	 */
+	cost_sort(&sort_path, root, pathkeys, 0.0, group_tuples, width,
+			  comparison_cost, sort_mem, -1.0);
+
+	/*
+	 * We must read and sort the first group before returning anything; the
+	 * remaining groups are read and sorted as we go.
+	 */
+	startup_cost = input_startup_cost + group_input_run_cost +
+		sort_path.startup_cost;
+	run_cost = (sort_path.total_cost - sort_path.startup_cost) +
+		(input_groups - 1) * (group_input_run_cost + sort_path.total_cost);
+
+	/* Comparing each tuple's presorted keys to find the group boundaries */
+	run_cost += (cpu_tuple_cost + comparison_cost +
+				 presorted_keys * cpu_operator_cost) * input_tuples;
+
+	if (!enable_incrementalsort)
+		startup_cost += disable_cost;
+
+	path->rows = input_tuples;
+	path->startup_cost = startup_cost;
+	path->total_cost = startup_cost + run_cost;
+}
+
 /*
  * cost_merge_append
  *	  Determines and returns the cost of a MergeAppend node.
@@ -1557,6 +1765,83 @@ cost_material(Path *path,
 	path->total_cost = startup_cost + run_cost;
 }
 
+/*
+ * cost_memoize
+ *	  Determines and returns the cost of the first scan of a Memoize node,
+ *	  and sets the number of cache entries we expect to fit in work_mem.
+ *
+ * The first scan always misses the cache, so it costs what the subpath
+ * costs plus the bookkeeping for caching its tuples.  The savings from
+ * later cache hits are estimated in cost_memoize_rescan.
+ */
+void
+cost_memoize(MemoizePath *mpath)
+{
+	Path	   *subpath = mpath->subpath;
+	double		tuples = subpath->rows;
+	double		entry_bytes;
+	Cost		lookup_cost;
+	long		work_mem_bytes = work_mem * 1024L;
+
+	if (mpath->singlerow)
+		tuples = Min(tuples, 1.0);
+
+	/* allow something for the hash table entry itself */
+	entry_bytes = relation_byte_size(tuples, subpath->parent->width) + 64;
+	mpath->est_entries = Max(floor(work_mem_bytes / entry_bytes), 1.0);
+
+	/* charge one operator per key for hashing it, as cost_agg does */
+	lookup_cost = cpu_operator_cost * list_length(mpath->param_exprs);
+
+	mpath->path.rows = subpath->rows;
+	mpath->path.startup_cost = subpath->startup_cost + lookup_cost;
+	mpath->path.total_cost = subpath->total_cost + lookup_cost +
+		2 * cpu_operator_cost * tuples;
+}
+
+/*
+ * cost_memoize_rescan
+ *	  Estimate the average cost of a rescan of a Memoize node.
+ *
+ * Of mpath->calls scans, the first one for each distinct set of parameter
+ * values has to run the subpath.  The others can be answered from the
+ * cache, provided it's still there; we assume that happens in proportion
+ * to the fraction of the distinct keys that fit in the cache.  A hit costs
+ * about as much as rescanning a Material node.
+ */
+static void
+cost_memoize_rescan(PlannerInfo *root, MemoizePath *mpath,
+					Cost *rescan_startup_cost, Cost *rescan_total_cost)
+{
+	Path	   *subpath = mpath->subpath;
+	double		calls = Max(mpath->calls, 1.0);
+	double		tuples = subpath->rows;
+	double		ndistinct;
+	double		hit_ratio;
+	Cost		sub_startup_cost;
+	Cost		sub_total_cost;
+	Cost		lookup_cost;
+	Cost		hit_cost;
+	Cost		miss_cost;
+
+	if (mpath->singlerow)
+		tuples = Min(tuples, 1.0);
+
+	ndistinct = estimate_num_groups(root, mpath->param_exprs, calls, NULL);
+	ndistinct = Min(Max(ndistinct, 1.0), calls);
+
+	hit_ratio = ((calls - ndistinct) / calls) *
+		Min(mpath->est_entries / ndistinct, 1.0);
+
+	cost_rescan(root, subpath, &sub_startup_cost, &sub_total_cost);
+	lookup_cost = cpu_operator_cost * list_length(mpath->param_exprs);
+	hit_cost = lookup_cost + cpu_operator_cost * tuples;
+	miss_cost = lookup_cost + sub_total_cost + 2 * cpu_operator_cost * tuples;
+
+	*rescan_startup_cost = lookup_cost + (1.0 - hit_ratio) * sub_startup_cost;
+	*rescan_total_cost = hit_ratio * hit_cost + (1.0 - hit_ratio) * miss_cost;
+}
+
 /*
  * cost_agg
  *		Determines and returns the cost of performing an Agg plan node,
@@ -1604,7 +1889,7 @@ cost_agg(Path *path, PlannerInfo *root,
 	 * Note: in this cost model, AGG_SORTED and AGG_HASHED have exactly the
 	 * same total CPU cost, but AGG_SORTED has lower startup cost.  If the
 	 * input path is already sorted appropriately, AGG_SORTED should be
-	 * preferred (since it has no risk of memory overflow).  This will happen
+	 * preferred (since it has no risk of spilling to disk).  This will happen
 	 * as long as the computed total costs are indeed exactly equal --- but if
 	 * there's roundoff error we might do the wrong thing.  So be sure that
 	 * the computations below form the same intermediate values in the same
@@ -2377,11 +2662,23 @@ final_cost_mergejoin(PlannerInfo *root, MergePath *path,
 	mat_inner_cost = inner_run_cost +
 		cpu_operator_cost * inner_path_rows * rescanratio;
 
+	/*
+	 * An unsorted index scan input never needs a Material node: the executor
+	 * keeps the current inner key group in its own buffer and re-reads it
+	 * from there (see nodeMergejoin.c), which costs about the same as a
+	 * Material node would.
+	 */
+	if (innersortkeys == NIL && IsA(inner_path, IndexPath))
+	{
+		path->materialize_inner = false;
+		bare_inner_cost = Min(bare_inner_cost, mat_inner_cost);
+	}
+
 	/*
 	 * Prefer materializing if it looks cheaper, unless the user has asked to
 	 * suppress materialization.
 	 */
-	if (enable_material && mat_inner_cost < bare_inner_cost)
+	else if (enable_material && mat_inner_cost < bare_inner_cost)
 		path->materialize_inner = true;
 
 	/*
@@ -2537,6 +2834,8 @@ cached_scansel(PlannerInfo *root, RestrictInfo *rinfo, PathKey *pathkey)
  * 'hashclauses' is the list of joinclauses to be used as hash clauses
  * 'outer_path' is the outer input to the join
  * 'inner_path' is the inner input to the join
+ * 'parallel_hash' is true if the (partial) inner path's output from all
+ *		participants is to be loaded into a single shared hash table
  * 'sjinfo' is extra info about the join for selectivity estimation
  * 'semifactors' contains valid data if jointype is SEMI or ANTI
  */
@@ -2545,6 +2844,7 @@ initial_cost_hashjoin(PlannerInfo *root, JoinCostWorkspace *workspace,
 					  JoinType jointype,
 					  List *hashclauses,
 					  Path *outer_path, Path *inner_path,
+					  bool parallel_hash,
 					  SpecialJoinInfo *sjinfo,
 					  SemiAntiJoinFactors *semifactors)
 {
@@ -2552,10 +2852,12 @@ initial_cost_hashjoin(PlannerInfo *root, JoinCostWorkspace *workspace,
 	Cost		run_cost = 0;
 	double		outer_path_rows = outer_path->rows;
 	double		inner_path_rows = inner_path->rows;
+	double		inner_rows_total = inner_path_rows;
 	int			num_hashclauses = list_length(hashclauses);
 	int			numbuckets;
 	int			numbatches;
 	int			num_skew_mcvs;
+	Size		arena_size;
 
 	/* cost of source data */
 	startup_cost += outer_path->startup_cost;
@@ -2566,7 +2868,8 @@ initial_cost_hashjoin(PlannerInfo *root, JoinCostWorkspace *workspace,
 	 * Cost of computing hash function: must do it once per input tuple. We
 	 * charge one cpu_operator_cost for each column's hash function.  Also,
 	 * tack on one cpu_tuple_cost per inner row, to model the costs of
-	 * inserting the row into the hashtable.
+	 * inserting the row into the hashtable.  With a shared hash table, each
+	 * participant only hashes and inserts its own share of the inner rows.
 	 *
 	 * XXX when a hashclause is more complex than a single operator, we really
 	 * should charge the extra eval costs of the left or right side, as
@@ -2585,13 +2888,27 @@ initial_cost_hashjoin(PlannerInfo *root, JoinCostWorkspace *workspace,
 	 *
 	 * XXX at some point it might be interesting to try to account for skew
 	 * optimization in the cost estimate, but for now, we don't.
+	 *
+	 * A shared hash table holds every participant's inner rows, and never
+	 * has more than one batch; our caller has checked that it should fit.
 	 */
-	ExecChooseHashTableSize(inner_path_rows,
-							inner_path->parent->width,
-							true,		/* useskew */
-							&numbuckets,
-							&numbatches,
-							&num_skew_mcvs);
+	if (parallel_hash)
+	{
+		inner_rows_total = inner_path->parent->rows;
+		(void) ExecChooseSharedHashTableSize(inner_rows_total,
+											 inner_path->parent->width,
+											 outer_path->parallel_degree + 1,
+											 &numbuckets,
+											 &arena_size);
+		numbatches = 1;
+	}
+	else
+		ExecChooseHashTableSize(inner_path_rows,
+								inner_path->parent->width,
+								true,	/* useskew */
+								&numbuckets,
+								&numbatches,
+								&num_skew_mcvs);
 
 	/*
 	 * If inner relation is too big then we will need to "batch" the join,
@@ -2620,6 +2937,7 @@ initial_cost_hashjoin(PlannerInfo *root, JoinCostWorkspace *workspace,
 	workspace->run_cost = run_cost;
 	workspace->numbuckets = numbuckets;
 	workspace->numbatches = numbatches;
+	workspace->inner_rows_total = inner_rows_total;
 }
 
 /*
@@ -2643,7 +2961,7 @@ final_cost_hashjoin(PlannerInfo *root, HashPath *path,
 	Path	   *outer_path = path->jpath.outerjoinpath;
 	Path	   *inner_path = path->jpath.innerjoinpath;
 	double		outer_path_rows = outer_path->rows;
-	double		inner_path_rows = inner_path->rows;
+	double		inner_path_rows = workspace->inner_rows_total;
 	List	   *hashclauses = path->path_hashclauses;
 	Cost		startup_cost = workspace->startup_cost;
 	Cost		run_cost = workspace->run_cost;
@@ -2663,6 +2981,12 @@ final_cost_hashjoin(PlannerInfo *root, HashPath *path,
 	else
 		path->jpath.path.rows = path->jpath.path.parent->rows;
 
+	/* A partial path produces only its share of the join's rows */
+	if (path->jpath.path.parallel_degree > 0)
+		path->jpath.path.rows =
+			clamp_row_est(path->jpath.path.rows /
+						  get_parallel_divisor(&path->jpath.path));
+
 	/*
 	 * We could include disable_cost in the preliminary estimate, but that
 	 * would amount to optimizing for the case where the join method is
@@ -2671,8 +2995,9 @@ final_cost_hashjoin(PlannerInfo *root, HashPath *path,
 	if (!enable_hashjoin)
 		startup_cost += disable_cost;
 
-	/* mark the path with estimated # of batches */
+	/* mark the path with estimated # of batches and size of a shared table */
 	path->num_batches = numbatches;
+	path->inner_rows_total = inner_path_rows;
 
 	/* and compute the number of "virtual" buckets in the whole join */
 	virtualbuckets = (double) numbuckets *(double) numbatches;
@@ -2820,9 +3145,12 @@ final_cost_hashjoin(PlannerInfo *root, HashPath *path,
 		/*
 		 * Get approx # tuples passing the hashquals.  We use
 		 * approx_tuple_count here because we need an estimate done with
-		 * JOIN_INNER semantics.
+		 * JOIN_INNER semantics.  It looks only at the inner path's share of
+		 * the rows, so scale up if we're probing a shared table.
 		 */
 		hashjointuples = approx_tuple_count(root, &path->jpath, hashclauses);
+		if (path->parallel_hash)
+			hashjointuples *= inner_path_rows / inner_path->rows;
 	}
 
 	/*
@@ -3020,6 +3348,10 @@ cost_rescan(PlannerInfo *root, Path *path,
 				*rescan_total_cost = run_cost;
 			}
 			break;
+		case T_Memoize:
+			cost_memoize_rescan(root, (MemoizePath *) path,
+								rescan_startup_cost, rescan_total_cost);
+			break;
 		default:
 			*rescan_startup_cost = path->startup_cost;
 			*rescan_total_cost = path->total_cost;
@@ -2273,6 +2273,36 @@ has_relevant_eclass_joinclause(PlannerInfo *root, RelOptInfo *rel1)
 	return false;
 }
 
+/*
+ * get_eclass_join_partners
+ *		Return the union of the relid sets of all EquivalenceClasses that
+ *		could produce a joinclause involving the given relation.
+ *
+ * Per the comments in have_relevant_eclass_joinclause, another rel could
+ * be joined to rel1 using some EC exactly when it overlaps the result of
+ * this function (apart from rel1's own relids, which are included).
+ */
+Relids
+get_eclass_join_partners(PlannerInfo *root, RelOptInfo *rel1)
+{
+	Relids		result = NULL;
+	ListCell   *lc1;
+
+	foreach(lc1, root->eq_classes)
+	{
+		EquivalenceClass *ec = (EquivalenceClass *) lfirst(lc1);
+
+		/* Won't generate joinclauses if single-member */
+		if (list_length(ec->ec_members) <= 1)
+			continue;
+
+		if (bms_overlap(rel1->relids, ec->ec_relids))
+			result = bms_add_members(result, ec->ec_relids);
+	}
+
+	return result;
+}
+
 
 /*
  * eclass_useful_for_merging
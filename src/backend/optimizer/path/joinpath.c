@@ -17,10 +17,15 @@
 #include <math.h>
 
 #include "executor/executor.h"
+#include "executor/nodeHash.h"
 #include "foreign/fdwapi.h"
+#include "nodes/nodeFuncs.h"
+#include "optimizer/clauses.h"
 #include "optimizer/cost.h"
 #include "optimizer/pathnode.h"
 #include "optimizer/paths.h"
+#include "utils/lsyscache.h"
+#include "utils/typcache.h"
 
 /* Hook for plugins to get control in add_paths_to_joinrel() */
 set_join_pathlist_hook_type set_join_pathlist_hook = NULL;
@@ -37,6 +42,17 @@ static void match_unsorted_outer(PlannerInfo *root, RelOptInfo *joinrel,
 static void hash_inner_and_outer(PlannerInfo *root, RelOptInfo *joinrel,
 					 RelOptInfo *outerrel, RelOptInfo *innerrel,
 					 JoinType jointype, JoinPathExtraData *extra);
+static Path *get_memoize_path(RelOptInfo *innerrel, RelOptInfo *outerrel,
+				 Path *inner_path, Path *outer_path,
+				 JoinType jointype, JoinPathExtraData *extra);
+static void try_partial_hashjoin_path(PlannerInfo *root,
+						  RelOptInfo *joinrel,
+						  Path *outer_path,
+						  Path *inner_path,
+						  List *hashclauses,
+						  JoinType jointype,
+						  JoinPathExtraData *extra,
+						  bool parallel_hash);
 static List *select_mergejoin_clauses(PlannerInfo *root,
 						 RelOptInfo *joinrel,
 						 RelOptInfo *outerrel,
@@ -491,7 +507,7 @@ try_hashjoin_path(PlannerInfo *root,
 	 * never have any output pathkeys, per comments in create_hashjoin_path.
 	 */
 	initial_cost_hashjoin(root, &workspace, jointype, hashclauses,
-						  outer_path, inner_path,
+						  outer_path, inner_path, false,
 						  extra->sjinfo, &extra->semifactors);
 
 	if (add_path_precheck(joinrel,
@@ -509,7 +525,8 @@ try_hashjoin_path(PlannerInfo *root,
 									  inner_path,
 									  extra->restrictlist,
 									  required_outer,
-									  hashclauses));
+									  hashclauses,
+									  false));
 	}
 	else
 	{
@@ -518,6 +535,75 @@ try_hashjoin_path(PlannerInfo *root,
 	}
 }
 
+/*
+ * try_partial_hashjoin_path
+ *	  Consider a partial hash join path, whose outer path is a partial path;
+ *	  if it looks cheaper than the joinrel's existing partial path, add it.
+ *
+ * If parallel_hash is true, the inner path is a partial path too, and the
+ * participants build one hash table from their shares of it in shared
+ * memory.  Otherwise the inner path is a complete path, and each participant
+ * builds a private hash table holding all of it.
+ */
+static void
+try_partial_hashjoin_path(PlannerInfo *root,
+						  RelOptInfo *joinrel,
+						  Path *outer_path,
+						  Path *inner_path,
+						  List *hashclauses,
+						  JoinType jointype,
+						  JoinPathExtraData *extra,
+						  bool parallel_hash)
+{
+	JoinCostWorkspace workspace;
+
+	/* Partial paths can't be parameterized */
+	if (inner_path->param_info != NULL ||
+		!bms_is_empty(extra->extra_lateral_rels))
+		return;
+
+	/*
+	 * A shared hash table can't be split into batches, so don't consider one
+	 * unless we expect the inner rel to fit in it.
+	 */
+	if (parallel_hash)
+	{
+		int			numbuckets;
+		Size		arena_size;
+
+		if (!ExecChooseSharedHashTableSize(inner_path->parent->rows,
+										   inner_path->parent->width,
+										   outer_path->parallel_degree + 1,
+										   &numbuckets,
+										   &arena_size))
+			return;
+	}
+
+	initial_cost_hashjoin(root, &workspace, jointype, hashclauses,
+						  outer_path, inner_path, parallel_hash,
+						  extra->sjinfo, &extra->semifactors);
+
+	/* Only the cheapest partial path is kept, so this is a cheap precheck */
+	if (joinrel->partial_pathlist != NIL &&
+		((Path *) linitial(joinrel->partial_pathlist))->total_cost <=
+		workspace.total_cost)
+		return;
+
+	add_partial_path(joinrel, (Path *)
+					 create_hashjoin_path(root,
+										  joinrel,
+										  jointype,
+										  &workspace,
+										  extra->sjinfo,
+										  &extra->semifactors,
+										  outer_path,
+										  inner_path,
+										  extra->restrictlist,
+										  NULL,
+										  hashclauses,
+										  parallel_hash));
+}
+
 /*
  * clause_sides_match_join
  *	  Determine whether a join clause is of the right form to use in this join.
@@ -885,6 +971,7 @@ match_unsorted_outer(PlannerInfo *root,
 			foreach(lc2, innerrel->cheapest_parameterized_paths)
 			{
 				Path	   *innerpath = (Path *) lfirst(lc2);
+				Path	   *mpath;
 
 				try_nestloop_path(root,
 								  joinrel,
@@ -893,6 +980,22 @@ match_unsorted_outer(PlannerInfo *root,
 								  merge_pathkeys,
 								  jointype,
 								  extra);
+
+				/*
+				 * Also consider caching the inner path's results for outer
+				 * rows with the same join keys
+				 */
+				mpath = get_memoize_path(innerrel, outerrel,
+										 innerpath, outerpath,
+										 jointype, extra);
+				if (mpath != NULL)
+					try_nestloop_path(root,
+									  joinrel,
+									  outerpath,
+									  mpath,
+									  merge_pathkeys,
+									  jointype,
+									  extra);
 			}
 
 			/* Also consider materialized form of the cheapest inner path */
@@ -1112,6 +1215,107 @@ match_unsorted_outer(PlannerInfo *root,
 	}
 }
 
+/*
+ * get_memoize_path
+ *	  If the results of 'inner_path', parameterized by 'outerrel', could be
+ *	  cached across the rescans driven by 'outer_path', return a MemoizePath
+ *	  doing that; else return NULL.
+ *
+ * We can only do this if we know every outer value the inner scan depends
+ * on, since those make up the cache key.  That's true for a base relation
+ * without lateral references whose parameterization comes entirely from
+ * the outer rel: the outer values then all appear in the join clauses
+ * listed in its ParamPathInfo.  Each key needs a hashable equality operator
+ * for its type.
+ */
+static Path *
+get_memoize_path(RelOptInfo *innerrel, RelOptInfo *outerrel,
+				 Path *inner_path, Path *outer_path,
+				 JoinType jointype, JoinPathExtraData *extra)
+{
+	List	   *param_exprs = NIL;
+	List	   *hash_operators = NIL;
+	bool		singlerow;
+	ListCell   *lc;
+
+	if (!enable_memoize || inner_path->param_info == NULL)
+		return NULL;
+	if (innerrel->reloptkind != RELOPT_BASEREL ||
+		innerrel->lateral_relids != NULL)
+		return NULL;
+	if (!bms_is_subset(PATH_REQ_OUTER(inner_path), outerrel->relids))
+		return NULL;
+
+	/* A cache is no use if the inner side will be scanned only once */
+	if (outer_path->rows < 2)
+		return NULL;
+
+	foreach(lc, inner_path->param_info->ppi_clauses)
+	{
+		RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+		OpExpr	   *opexpr;
+		Node	   *expr;
+		Oid			exprtype;
+		TypeCacheEntry *typentry;
+
+		if (!is_opclause(rinfo->clause) ||
+			list_length(((OpExpr *) rinfo->clause)->args) != 2)
+			return NULL;
+		opexpr = (OpExpr *) rinfo->clause;
+
+		if (bms_is_subset(rinfo->left_relids, outerrel->relids) &&
+			bms_is_subset(rinfo->right_relids, innerrel->relids))
+			expr = (Node *) linitial(opexpr->args);
+		else if (bms_is_subset(rinfo->left_relids, innerrel->relids) &&
+				 bms_is_subset(rinfo->right_relids, outerrel->relids))
+			expr = (Node *) lsecond(opexpr->args);
+		else
+			return NULL;
+
+		if (contain_volatile_functions(expr))
+			return NULL;
+
+		exprtype = exprType(expr);
+		typentry = lookup_type_cache(exprtype, TYPECACHE_EQ_OPR);
+		if (!OidIsValid(typentry->eq_opr) ||
+			!op_hashjoinable(typentry->eq_opr, exprtype))
+			return NULL;
+
+		if (list_member(param_exprs, expr))
+			continue;
+		param_exprs = lappend(param_exprs, expr);
+		hash_operators = lappend_oid(hash_operators, typentry->eq_opr);
+	}
+
+	if (param_exprs == NIL)
+		return NULL;
+
+	/*
+	 * A semi or anti join stops reading the inner side at its first match.
+	 * If the inner path checks all the join clauses itself, that's its first
+	 * row, so that's all we need to cache.  Otherwise a scan may be cut short
+	 * anywhere, and the executor just fills the entry again next time.
+	 */
+	singlerow = false;
+	if (jointype == JOIN_SEMI || jointype == JOIN_ANTI)
+	{
+		singlerow = true;
+		foreach(lc, extra->restrictlist)
+		{
+			if (!list_member_ptr(inner_path->param_info->ppi_clauses,
+								 lfirst(lc)))
+			{
+				singlerow = false;
+				break;
+			}
+		}
+	}
+
+	return (Path *) create_memoize_path(innerrel, inner_path, param_exprs,
+										hash_operators, singlerow,
+										outer_path->rows);
+}
+
 /*
  * hash_inner_and_outer
  *	  Create hashjoin join paths by explicitly hashing both the outer and
@@ -1189,6 +1393,51 @@ hash_inner_and_outer(PlannerInfo *root,
 			PATH_PARAM_BY_REL(cheapest_total_inner, outerrel))
 			return;
 
+		/*
+		 * If the join can be done in parallel workers, consider joining the
+		 * outer rel's partial path, so that each participant joins its own
+		 * share of the outer rel against all of the inner rel.  Right and
+		 * full joins are out, since no participant could tell which inner
+		 * tuples went unmatched; so are the unique-ified cases, since the
+		 * outer rel's output can't be unique-ified piecemeal.
+		 *
+		 * The inner rel can be hashed separately by each participant from a
+		 * complete path, but workers can only run plan types that readfuncs.c
+		 * knows about, and for now that means a plain sequential scan.  Or
+		 * the participants can build a shared hash table together from the
+		 * inner rel's partial path.
+		 */
+		if (joinrel->consider_parallel &&
+			outerrel->partial_pathlist != NIL &&
+			(jointype == JOIN_INNER || jointype == JOIN_LEFT ||
+			 jointype == JOIN_SEMI || jointype == JOIN_ANTI))
+		{
+			Path	   *partial_outer;
+
+			partial_outer = (Path *) linitial(outerrel->partial_pathlist);
+
+			if (cheapest_total_inner->pathtype == T_SeqScan &&
+				cheapest_total_inner->param_info == NULL)
+				try_partial_hashjoin_path(root,
+										  joinrel,
+										  partial_outer,
+										  cheapest_total_inner,
+										  hashclauses,
+										  jointype,
+										  extra,
+										  false);
+
+			if (enable_parallel_hash && innerrel->partial_pathlist != NIL)
+				try_partial_hashjoin_path(root,
+										  joinrel,
+										  partial_outer,
+								 (Path *) linitial(innerrel->partial_pathlist),
+										  hashclauses,
+										  jointype,
+										  extra,
+										  true);
+		}
+
 		/* Unique-ify if need be; we ignore parameterized possibilities */
 		if (jointype == JOIN_UNIQUE_OUTER)
 		{
@@ -22,6 +22,7 @@
 #include "nodes/nodeFuncs.h"
 #include "nodes/plannodes.h"
 #include "optimizer/clauses.h"
+#include "optimizer/cost.h"
 #include "optimizer/pathnode.h"
 #include "optimizer/paths.h"
 #include "optimizer/tlist.h"
@@ -330,6 +331,30 @@ pathkeys_contained_in(List *keys1, List *keys2)
 	return false;
 }
 
+/*
+ * pathkeys_common
+ *	  Return the number of leading pathkeys that keys1 and keys2 have in
+ *	  common.  A path sorted by keys2 is then sorted by that many of keys1,
+ *	  which is what an incremental sort needs to know.
+ */
+int
+pathkeys_common(List *keys1, List *keys2)
+{
+	int			n = 0;
+	ListCell   *key1,
+			   *key2;
+
+	/* As in compare_pathkeys, canonical pathkeys can be compared by pointer */
+	forboth(key1, keys1, key2, keys2)
+	{
+		if (lfirst(key1) != lfirst(key2))
+			break;
+		n++;
+	}
+
+	return n;
+}
+
 /*
  * get_cheapest_path_for_pathkeys
  *	  Find the cheapest path (according to the specified criterion) that
@@ -453,6 +478,10 @@ build_index_pathkeys(PlannerInfo *root,
 		bool		nulls_first;
 		PathKey    *cpathkey;
 
+		/* Non-key INCLUDE columns don't contribute to the ordering */
+		if (i >= index->nkeycolumns)
+			break;
+
 		/* We assume we don't need to make a copy of the tlist item */
 		indexkey = indextle->expr;
 
@@ -1450,13 +1479,18 @@ right_merge_direction(PlannerInfo *root, PathKey *pathkey)
  *		Count the number of pathkeys that are useful for meeting the
  *		query's requested output ordering.
  *
- * Unlike merge pathkeys, this is an all-or-nothing affair: it does us
- * no good to order by just the first key(s) of the requested ordering.
- * So the result is always either 0 or list_length(root->query_pathkeys).
+ * Unlike merge pathkeys, this is mostly an all-or-nothing affair: usually
+ * it does us no good to order by just the first key(s) of the requested
+ * ordering, so the result is either 0 or list_length(root->query_pathkeys).
+ * The exception is the final ORDER BY, which grouping_planner can finish
+ * with an incremental sort if the path is sorted by a prefix of it; so then
+ * an ordering by the first few keys counts as useful too.
  */
 static int
 pathkeys_useful_for_ordering(PlannerInfo *root, List *pathkeys)
 {
+	int			n_common;
+
 	if (root->query_pathkeys == NIL)
 		return 0;				/* no special ordering requested */
 
@@ -1469,6 +1503,14 @@ pathkeys_useful_for_ordering(PlannerInfo *root, List *pathkeys)
 		return list_length(root->query_pathkeys);
 	}
 
+	if (enable_incrementalsort &&
+		root->query_pathkeys == root->sort_pathkeys)
+	{
+		n_common = pathkeys_common(root->query_pathkeys, pathkeys);
+		if (n_common > 0)
+			return n_common;	/* usable as input to an incremental sort */
+	}
+
 	return 0;					/* path ordering not useful */
 }
 
@@ -53,9 +53,14 @@ static Plan *create_gating_plan(PlannerInfo *root, Plan *plan, List *quals);
 static Plan *create_join_plan(PlannerInfo *root, JoinPath *best_path);
 static Plan *create_append_plan(PlannerInfo *root, AppendPath *best_path);
 static Plan *create_merge_append_plan(PlannerInfo *root, MergeAppendPath *best_path);
+static void create_append_prune_info(PlannerInfo *root, List *subpaths,
+						 List **prunequals, List **pruneconstrs);
 static Result *create_result_plan(PlannerInfo *root, ResultPath *best_path);
 static Material *create_material_plan(PlannerInfo *root, MaterialPath *best_path);
+static Memoize *create_memoize_plan(PlannerInfo *root, MemoizePath *best_path);
 static Plan *create_unique_plan(PlannerInfo *root, UniquePath *best_path);
+static Gather *create_gather_plan(PlannerInfo *root,
+				   GatherPath *best_path);
 static SeqScan *create_seqscan_plan(PlannerInfo *root, Path *best_path,
 					List *tlist, List *scan_clauses);
 static SampleScan *create_samplescan_plan(PlannerInfo *root, Path *best_path,
@@ -161,6 +166,11 @@ static Sort *make_sort(PlannerInfo *root, Plan *lefttree, int numCols,
 		  AttrNumber *sortColIdx, Oid *sortOperators,
 		  Oid *collations, bool *nullsFirst,
 		  double limit_tuples);
+static IncrementalSort *make_incrementalsort(PlannerInfo *root,
+					 Plan *lefttree, int numCols, int presortedCols,
+					 AttrNumber *sortColIdx, Oid *sortOperators,
+					 Oid *collations, bool *nullsFirst,
+					 List *pathkeys, double limit_tuples);
 static Plan *prepare_sort_from_pathkeys(PlannerInfo *root,
 						   Plan *lefttree, List *pathkeys,
 						   Relids relids,
@@ -175,6 +185,8 @@ static EquivalenceMember *find_ec_member_for_tle(EquivalenceClass *ec,
 					   TargetEntry *tle,
 					   Relids relids);
 static Material *make_material(Plan *lefttree);
+static Memoize *make_memoize(Plan *lefttree, List *hash_operators,
+			 List *param_exprs, bool singlerow, long est_entries);
 
 
 /*
@@ -268,10 +280,18 @@ create_plan_recurse(PlannerInfo *root, Path *best_path)
 			plan = (Plan *) create_material_plan(root,
 												 (MaterialPath *) best_path);
 			break;
+		case T_Memoize:
+			plan = (Plan *) create_memoize_plan(root,
+												(MemoizePath *) best_path);
+			break;
 		case T_Unique:
 			plan = create_unique_plan(root,
 									  (UniquePath *) best_path);
 			break;
+		case T_Gather:
+			plan = (Plan *) create_gather_plan(root,
+											   (GatherPath *) best_path);
+			break;
 		default:
 			elog(ERROR, "unrecognized node type: %d",
 				 (int) best_path->pathtype);
@@ -744,6 +764,9 @@ create_append_plan(PlannerInfo *root, AppendPath *best_path)
 
 	plan = make_append(subplans, tlist);
 
+	create_append_prune_info(root, best_path->subpaths,
+							 &plan->prunequals, &plan->pruneconstrs);
+
 	return (Plan *) plan;
 }
 
@@ -845,9 +868,53 @@ create_merge_append_plan(PlannerInfo *root, MergeAppendPath *best_path)
 
 	node->mergeplans = subplans;
 
+	create_append_prune_info(root, best_path->subpaths,
+							 &node->prunequals, &node->pruneconstrs);
+
 	return (Plan *) node;
 }
 
+/*
+ * create_append_prune_info
+ *	  Collect what the executor needs to skip children of an Append or
+ *	  MergeAppend that can't return any rows given the values of external
+ *	  Params.  If no child is subject to that, both lists are set to NIL;
+ *	  otherwise they get one item per subpath.
+ */
+static void
+create_append_prune_info(PlannerInfo *root, List *subpaths,
+						 List **prunequals, List **pruneconstrs)
+{
+	List	   *quals_list = NIL;
+	List	   *constrs_list = NIL;
+	bool		prunable = false;
+	ListCell   *lc;
+
+	foreach(lc, subpaths)
+	{
+		Path	   *subpath = (Path *) lfirst(lc);
+		List	   *quals;
+		List	   *constraints;
+
+		if (get_relation_prune_info(root, subpath->parent,
+									&quals, &constraints))
+			prunable = true;
+		quals_list = lappend(quals_list, quals);
+		constrs_list = lappend(constrs_list, constraints);
+	}
+
+	if (prunable)
+	{
+		*prunequals = quals_list;
+		*pruneconstrs = constrs_list;
+	}
+	else
+	{
+		*prunequals = NIL;
+		*pruneconstrs = NIL;
+	}
+}
+
 /*
  * create_result_plan
  *	  Create a Result plan for 'best_path'.
@@ -897,6 +964,37 @@ create_material_plan(PlannerInfo *root, MaterialPath *best_path)
 	return plan;
 }
 
+/*
+ * create_memoize_plan
+ *	  Create a Memoize plan for 'best_path' and (recursively) plans
+ *	  for its subpaths.
+ *
+ *	  Returns a Plan node.
+ */
+static Memoize *
+create_memoize_plan(PlannerInfo *root, MemoizePath *best_path)
+{
+	Memoize    *plan;
+	Plan	   *subplan;
+	List	   *param_exprs;
+
+	subplan = create_plan_recurse(root, best_path->subpath);
+
+	/* We don't want any excess columns in the cached tuples */
+	disuse_physical_tlist(root, subplan, best_path->subpath);
+
+	/* The key expressions use the values the nestloop passes down */
+	param_exprs = (List *)
+		replace_nestloop_params(root, (Node *) best_path->param_exprs);
+
+	plan = make_memoize(subplan, best_path->hash_operators, param_exprs,
+						best_path->singlerow, (long) best_path->est_entries);
+
+	copy_path_costsize(&plan->plan, (Path *) best_path);
+
+	return plan;
+}
+
 /*
  * create_unique_plan
  *	  Create a Unique plan for 'best_path' and (recursively) plans
@@ -1044,6 +1142,8 @@ create_unique_plan(PlannerInfo *root, UniquePath *best_path)
 								 groupOperators,
 								 NIL,
 								 numGroups,
+								 false,
+								 true,
 								 subplan);
 	}
 	else
@@ -1101,6 +1201,39 @@ create_unique_plan(PlannerInfo *root, UniquePath *best_path)
 }
 
 
+/*
+ * create_gather_plan
+ *
+ *	  Create a Gather plan for 'best_path' and (recursively) plans
+ *	  for its subpaths.
+ */
+static Gather *
+create_gather_plan(PlannerInfo *root, GatherPath *best_path)
+{
+	Gather	   *gather_plan;
+	Plan	   *subplan;
+
+	subplan = create_plan_recurse(root, best_path->subpath);
+
+	/*
+	 * Every column of the subplan's output has to be sent from the workers
+	 * to the leader through a tuple queue, so don't ship any excess columns.
+	 */
+	disuse_physical_tlist(root, subplan, best_path->subpath);
+
+	gather_plan = make_gather(subplan->targetlist,
+							  NIL,
+							  best_path->num_workers,
+							  subplan);
+
+	copy_path_costsize(&gather_plan->plan, &best_path->path);
+
+	/* use parallel mode for parallel plans. */
+	root->glob->parallelModeNeeded = true;
+
+	return gather_plan;
+}
+
 /*****************************************************************************
  *
  *	BASE-RELATION SCAN METHODS
@@ -2671,9 +2804,9 @@ create_hashjoin_plan(PlannerInfo *root,
 	 * skew optimization.  (Note: in principle we could do skew optimization
 	 * with multiple join clauses, but we'd have to be able to determine the
 	 * most common combinations of outer values, which we don't currently have
-	 * enough stats for.)
+	 * enough stats for.)  A shared hash table has no skew buckets.
 	 */
-	if (list_length(hashclauses) == 1)
+	if (list_length(hashclauses) == 1 && !best_path->parallel_hash)
 	{
 		OpExpr	   *clause = (OpExpr *) linitial(hashclauses);
 		Node	   *node;
@@ -2708,6 +2841,17 @@ create_hashjoin_plan(PlannerInfo *root,
 						  skewInherit,
 						  skewColType,
 						  skewColTypmod);
+
+	/*
+	 * A parallel-aware Hash node builds its table in shared memory, and needs
+	 * to know how big the whole of it will be.
+	 */
+	if (best_path->parallel_hash)
+	{
+		hash_plan->plan.parallel_aware = true;
+		hash_plan->rows_total = best_path->inner_rows_total;
+	}
+
 	join_plan = make_hashjoin(tlist,
 							  joinclauses,
 							  otherclauses,
@@ -3362,6 +3506,7 @@ copy_path_costsize(Plan *dest, Path *src)
 		dest->total_cost = src->total_cost;
 		dest->plan_rows = src->rows;
 		dest->plan_width = src->parent->width;
+		dest->parallel_aware = src->parallel_aware;
 	}
 	else
 	{
@@ -3369,6 +3514,7 @@ copy_path_costsize(Plan *dest, Path *src)
 		dest->total_cost = 0;
 		dest->plan_rows = 0;
 		dest->plan_width = 0;
+		dest->parallel_aware = false;
 	}
 }
 
@@ -3692,6 +3838,7 @@ make_foreignscan(List *qptlist,
 	plan->lefttree = NULL;
 	plan->righttree = NULL;
 	node->scan.scanrelid = scanrelid;
+	node->operation = CMD_SELECT;
 	/* fs_server will be filled in by create_foreignscan_plan */
 	node->fs_server = InvalidOid;
 	node->fdw_exprs = fdw_exprs;
@@ -3990,6 +4137,48 @@ make_sort(PlannerInfo *root, Plan *lefttree, int numCols,
 	return node;
 }
 
+/*
+ * make_incrementalsort --- basic routine to build an IncrementalSort plan node
+ *
+ * Like make_sort, except that the input is known to be sorted already on the
+ * first presortedCols columns.  The pathkeys are needed for costing.
+ */
+static IncrementalSort *
+make_incrementalsort(PlannerInfo *root, Plan *lefttree,
+					 int numCols, int presortedCols,
+					 AttrNumber *sortColIdx, Oid *sortOperators,
+					 Oid *collations, bool *nullsFirst,
+					 List *pathkeys, double limit_tuples)
+{
+	IncrementalSort *node = makeNode(IncrementalSort);
+	Plan	   *plan = &node->sort.plan;
+	Path		sort_path;		/* dummy for result of cost_incremental_sort */
+
+	copy_plan_costsize(plan, lefttree); /* only care about copying size */
+	cost_incremental_sort(&sort_path, root, pathkeys, presortedCols,
+						  lefttree->startup_cost,
+						  lefttree->total_cost,
+						  lefttree->plan_rows,
+						  lefttree->plan_width,
+						  0.0,
+						  work_mem,
+						  limit_tuples);
+	plan->startup_cost = sort_path.startup_cost;
+	plan->total_cost = sort_path.total_cost;
+	plan->targetlist = lefttree->targetlist;
+	plan->qual = NIL;
+	plan->lefttree = lefttree;
+	plan->righttree = NULL;
+	node->sort.numCols = numCols;
+	node->sort.sortColIdx = sortColIdx;
+	node->sort.sortOperators = sortOperators;
+	node->sort.collations = collations;
+	node->sort.nullsFirst = nullsFirst;
+	node->presortedCols = presortedCols;
+
+	return node;
+}
+
 /*
  * prepare_sort_from_pathkeys
  *	  Prepare to sort according to given pathkeys
@@ -4335,6 +4524,46 @@ make_sort_from_pathkeys(PlannerInfo *root, Plan *lefttree, List *pathkeys,
 					 nullsFirst, limit_tuples);
 }
 
+/*
+ * make_incrementalsort_from_pathkeys
+ *	  Create an incremental sort plan to sort according to given pathkeys,
+ *	  when the input is already sorted by the first presortedCols of them
+ *
+ *	  'lefttree' is the node which yields input tuples
+ *	  'pathkeys' is the list of pathkeys by which the result is to be sorted
+ *	  'presortedCols' is the number of leading pathkeys lefttree is sorted by
+ *	  'limit_tuples' is the bound on the number of output tuples;
+ *				-1 if no bound
+ */
+IncrementalSort *
+make_incrementalsort_from_pathkeys(PlannerInfo *root, Plan *lefttree,
+								   List *pathkeys, int presortedCols,
+								   double limit_tuples)
+{
+	int			numsortkeys;
+	AttrNumber *sortColIdx;
+	Oid		   *sortOperators;
+	Oid		   *collations;
+	bool	   *nullsFirst;
+
+	/* Compute sort column info, and adjust lefttree as needed */
+	lefttree = prepare_sort_from_pathkeys(root, lefttree, pathkeys,
+										  NULL,
+										  NULL,
+										  false,
+										  &numsortkeys,
+										  &sortColIdx,
+										  &sortOperators,
+										  &collations,
+										  &nullsFirst);
+	Assert(presortedCols > 0 && presortedCols < numsortkeys);
+
+	/* Now build the IncrementalSort node */
+	return make_incrementalsort(root, lefttree, numsortkeys, presortedCols,
+								sortColIdx, sortOperators, collations,
+								nullsFirst, pathkeys, limit_tuples);
+}
+
 /*
  * make_sort_from_sortclauses
  *	  Create sort plan to sort according to given sortclauses
@@ -4448,6 +4677,33 @@ make_material(Plan *lefttree)
 	return node;
 }
 
+static Memoize *
+make_memoize(Plan *lefttree, List *hash_operators, List *param_exprs,
+			 bool singlerow, long est_entries)
+{
+	Memoize    *node = makeNode(Memoize);
+	Plan	   *plan = &node->plan;
+	ListCell   *lc;
+	int			i;
+
+	/* cost should be inserted by caller */
+	plan->targetlist = lefttree->targetlist;
+	plan->qual = NIL;
+	plan->lefttree = lefttree;
+	plan->righttree = NULL;
+
+	node->numKeys = list_length(param_exprs);
+	node->hashOperators = (Oid *) palloc(node->numKeys * sizeof(Oid));
+	i = 0;
+	foreach(lc, hash_operators)
+		node->hashOperators[i++] = lfirst_oid(lc);
+	node->param_exprs = param_exprs;
+	node->singlerow = singlerow;
+	node->est_entries = est_entries;
+
+	return node;
+}
+
 /*
  * materialize_finished_plan: stick a Material node atop a completed plan
  *
@@ -4488,9 +4744,8 @@ Agg *
 make_agg(PlannerInfo *root, List *tlist, List *qual,
 		 AggStrategy aggstrategy, const AggClauseCosts *aggcosts,
 		 int numGroupCols, AttrNumber *grpColIdx, Oid *grpOperators,
-		 List *groupingSets,
-		 long numGroups,
-		 Plan *lefttree)
+		 List *groupingSets, long numGroups, bool combineStates,
+		 bool finalizeAggs, Plan *lefttree)
 {
 	Agg		   *node = makeNode(Agg);
 	Plan	   *plan = &node->plan;
@@ -4498,6 +4753,8 @@ make_agg(PlannerInfo *root, List *tlist, List *qual,
 	QualCost	qual_cost;
 
 	node->aggstrategy = aggstrategy;
+	node->combineStates = combineStates;
+	node->finalizeAggs = finalizeAggs;
 	node->numCols = numGroupCols;
 	node->grpColIdx = grpColIdx;
 	node->grpOperators = grpOperators;
@@ -4722,6 +4979,25 @@ make_unique(Plan *lefttree, List *distinctList)
 	return node;
 }
 
+Gather *
+make_gather(List *qptlist,
+			List *qpqual,
+			int nworkers,
+			Plan *subplan)
+{
+	Gather	   *node = makeNode(Gather);
+	Plan	   *plan = &node->plan;
+
+	/* cost should be inserted by caller */
+	plan->targetlist = qptlist;
+	plan->qual = qpqual;
+	plan->lefttree = subplan;
+	plan->righttree = NULL;
+	node->num_workers = nworkers;
+
+	return node;
+}
+
 /*
  * distinctList is a list of SortGroupClauses, identifying the targetlist
  * items that should be considered by the SetOp filter.  The input path must
@@ -4953,6 +5229,7 @@ make_modifytable(PlannerInfo *root,
 	Plan	   *plan = &node->plan;
 	double		total_size;
 	List	   *fdw_private_list;
+	Bitmapset  *direct_modify_plans;
 	ListCell   *subnode;
 	ListCell   *lc;
 	int			i;
@@ -5030,9 +5307,12 @@ make_modifytable(PlannerInfo *root,
 
 	/*
 	 * For each result relation that is a foreign table, allow the FDW to
-	 * construct private plan data, and accumulate it all into a list.
+	 * construct private plan data, and accumulate it all into a list.  If
+	 * the FDW can instead perform the whole UPDATE or DELETE remotely, it
+	 * rewrites the subplan's ForeignScan to do so; we remember that here.
 	 */
 	fdw_private_list = NIL;
+	direct_modify_plans = NULL;
 	i = 0;
 	foreach(lc, resultRelations)
 	{
@@ -5065,8 +5345,23 @@ make_modifytable(PlannerInfo *root,
 				fdwroutine = NULL;
 		}
 
+		/*
+		 * Try to modify the foreign table directly, if the statement is an
+		 * UPDATE or DELETE without ON CONFLICT, and the FDW supports it.
+		 */
 		if (fdwroutine != NULL &&
-			fdwroutine->PlanForeignModify != NULL)
+			fdwroutine->PlanDirectModify != NULL &&
+			fdwroutine->BeginDirectModify != NULL &&
+			fdwroutine->IterateDirectModify != NULL &&
+			fdwroutine->EndDirectModify != NULL &&
+			(operation == CMD_UPDATE || operation == CMD_DELETE) &&
+			fdwroutine->PlanDirectModify(root, node, rti, i))
+		{
+			direct_modify_plans = bms_add_member(direct_modify_plans, i);
+			fdw_private = NIL;
+		}
+		else if (fdwroutine != NULL &&
+				 fdwroutine->PlanForeignModify != NULL)
 			fdw_private = fdwroutine->PlanForeignModify(root, node, rti, i);
 		else
 			fdw_private = NIL;
@@ -5074,6 +5369,7 @@ make_modifytable(PlannerInfo *root,
 		i++;
 	}
 	node->fdwPrivLists = fdw_private_list;
+	node->fdwDirectModifyPlans = direct_modify_plans;
 
 	return node;
 }
@@ -5090,7 +5386,9 @@ is_projection_capable_plan(Plan *plan)
 	{
 		case T_Hash:
 		case T_Material:
+		case T_Memoize:
 		case T_Sort:
+		case T_IncrementalSort:
 		case T_Unique:
 		case T_SetOp:
 		case T_LockRows:
@@ -5099,6 +5397,7 @@ is_projection_capable_plan(Plan *plan)
 		case T_Append:
 		case T_MergeAppend:
 		case T_RecursiveUnion:
+		case T_Gather:
 			return false;
 		default:
 			break;
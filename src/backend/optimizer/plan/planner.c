@@ -19,6 +19,10 @@
 #include <math.h>
 
 #include "access/htup_details.h"
+#include "access/parallel.h"
+#include "access/xact.h"
+#include "catalog/pg_aggregate.h"
+#include "catalog/pg_type.h"
 #include "executor/executor.h"
 #include "executor/nodeAgg.h"
 #include "foreign/fdwapi.h"
@@ -43,8 +47,10 @@
 #include "parser/parsetree.h"
 #include "parser/parse_agg.h"
 #include "rewrite/rewriteManip.h"
+#include "storage/dsm_impl.h"
 #include "utils/rel.h"
 #include "utils/selfuncs.h"
+#include "utils/syscache.h"
 
 
 /* GUC parameter */
@@ -66,6 +72,12 @@ planner_hook_type planner_hook = NULL;
 #define EXPRKIND_PHV			8
 #define EXPRKIND_TABLESAMPLE	9
 
+/* Passthrough data for make_final_agg_expr_mutator */
+typedef struct
+{
+	List	   *partial_tlist;	/* tlist of the partial Agg, being built */
+} partial_agg_context;
+
 /* Passthrough data for standard_qp_callback */
 typedef struct
 {
@@ -74,6 +86,13 @@ typedef struct
 	List	   *groupClause;	/* overrides parse->groupClause */
 } standard_qp_extra;
 
+/* Sort key data for select_active_windows */
+typedef struct
+{
+	WindowClause *wc;			/* the window clause */
+	List	   *uniqueOrder;	/* its partitioning and ordering clauses */
+} WindowClauseSortData;
+
 /* Local functions */
 static Node *preprocess_expression(PlannerInfo *root, Node *expr, int kind);
 static void preprocess_qual_conditions(PlannerInfo *root, Node *jtnode);
@@ -93,6 +112,12 @@ static bool choose_hashed_grouping(PlannerInfo *root,
 					   double path_rows, int path_width,
 					   Path *cheapest_path, Path *sorted_path,
 					   double dNumGroups, AggClauseCosts *agg_costs);
+static bool choose_hashed_grouping_sets(PlannerInfo *root,
+							double tuple_fraction, double limit_tuples,
+							double path_rows, int path_width,
+							Path *cheapest_path, Path *sorted_path,
+							List *rollup_groupclauses, List *rollup_lists,
+							double dNumGroups, AggClauseCosts *agg_costs);
 static bool choose_hashed_distinct(PlannerInfo *root,
 					   double tuple_fraction, double limit_tuples,
 					   double path_rows, int path_width,
@@ -100,6 +125,40 @@ static bool choose_hashed_distinct(PlannerInfo *root,
 					   Cost sorted_startup_cost, Cost sorted_total_cost,
 					   List *sorted_pathkeys,
 					   double dNumDistinctRows);
+static Path *choose_incremental_sort_path(PlannerInfo *root,
+							 RelOptInfo *final_rel,
+							 double tuple_fraction,
+							 double path_rows, int path_width,
+							 Path *cheapest_path, Path *sorted_path);
+static bool use_incremental_sort(PlannerInfo *root, Plan *lefttree,
+					 List *pathkeys, int presorted_keys,
+					 double limit_tuples);
+static Plan *make_parallel_agg_plan(PlannerInfo *root, RelOptInfo *final_rel,
+					   List *tlist, List *sub_tlist,
+					   const AggClauseCosts *agg_costs,
+					   int numGroupCols, AttrNumber *groupColIdx,
+					   double dNumGroups, bool use_hashed_grouping,
+					   Path *best_path);
+static Plan *make_partitionwise_agg_plan(PlannerInfo *root,
+							RelOptInfo *final_rel,
+							List *tlist, List *sub_tlist,
+							const AggClauseCosts *agg_costs,
+							int numGroupCols, AttrNumber *groupColIdx,
+							double dNumGroups, bool use_hashed_grouping,
+							Path *best_path);
+static void cost_sorted_grouping(PlannerInfo *root, Path *result_p,
+					 Path *input_path, int input_width,
+					 const AggClauseCosts *agg_costs,
+					 int numGroupCols, double numGroups);
+static Plan *make_foreign_agg_plan(PlannerInfo *root, RelOptInfo *final_rel,
+					  List *tlist,
+					  const AggClauseCosts *agg_costs,
+					  int numGroupCols, double dNumGroups,
+					  bool use_hashed_grouping, Path *best_path);
+static bool aggregates_are_combinable(Node *node);
+static bool aggregates_are_combinable_walker(Node *node, void *context);
+static Node *make_final_agg_expr_mutator(Node *node,
+							partial_agg_context *context);
 static List *make_subplanTargetList(PlannerInfo *root, List *tlist,
 					   AttrNumber **groupColIdx, bool *need_tlist_eval);
 static int	get_grouping_column_index(Query *parse, TargetEntry *tle);
@@ -109,6 +168,7 @@ static void locate_grouping_columns(PlannerInfo *root,
 						AttrNumber *groupColIdx);
 static List *postprocess_setop_tlist(List *new_tlist, List *orig_tlist);
 static List *select_active_windows(PlannerInfo *root, WindowFuncLists *wflists);
+static int	common_prefix_cmp(const void *a, const void *b);
 static List *make_windowInputTargetList(PlannerInfo *root,
 						   List *tlist, List *activeWindows);
 static List *make_pathkeys_for_window(PlannerInfo *root, WindowClause *wc,
@@ -132,6 +192,14 @@ static Plan *build_grouping_chain(PlannerInfo *root,
 					 AggClauseCosts *agg_costs,
 					 long numGroups,
 					 Plan *result_plan);
+static Plan *build_hashed_grouping_sets(PlannerInfo *root,
+						   Query *parse,
+						   List *tlist,
+						   List *rollup_groupclauses,
+						   List *rollup_lists,
+						   AggClauseCosts *agg_costs,
+						   double path_rows,
+						   Plan *result_plan);
 
 /*****************************************************************************
  *
@@ -194,9 +262,41 @@ standard_planner(Query *parse, int cursorOptions, ParamListInfo boundParams)
 	glob->nParamExec = 0;
 	glob->lastPHId = 0;
 	glob->lastRowMarkId = 0;
+	glob->lastPlanNodeId = 0;
 	glob->transientPlan = false;
 	glob->hasRowSecurity = false;
 
+	/*
+	 * Assess whether it's feasible to use parallel mode for this query.  We
+	 * can't do this in a standalone backend, or if the command will try to
+	 * modify any data, or if this is a cursor operation, or if GUCs are set
+	 * to values that don't permit parallelism, or if parallel-unsafe
+	 * functions are present in the query tree.  The caller must also have
+	 * indicated that it is prepared to run the query to completion in one
+	 * go, since parallel mode can't be held open across calls.
+	 *
+	 * For now, we don't try to use parallel mode if we're running inside a
+	 * parallel worker.  We might eventually be able to relax this
+	 * restriction, but for now it seems best not to have parallel workers
+	 * trying to create their own parallel workers.
+	 *
+	 * We also don't use parallel mode at serializable isolation level,
+	 * because the workers would not participate in the leader's predicate
+	 * locking.
+	 */
+	glob->parallelModeOK = (cursorOptions & CURSOR_OPT_PARALLEL_OK) != 0 &&
+		IsUnderPostmaster &&
+		dynamic_shared_memory_type != DSM_IMPL_NONE &&
+		max_parallel_degree > 0 &&
+		parse->commandType == CMD_SELECT &&
+		parse->utilityStmt == NULL &&
+		!parse->hasModifyingCTE &&
+		parse->rowMarks == NIL &&
+		!IsParallelWorker() &&
+		!IsolationIsSerializable() &&
+		!has_parallel_hazard((Node *) parse, true);
+	glob->parallelModeNeeded = false;
+
 	/* Determine what fraction of the plan is likely to be scanned */
 	if (cursorOptions & CURSOR_OPT_FAST_PLAN)
 	{
@@ -274,6 +374,7 @@ standard_planner(Query *parse, int cursorOptions, ParamListInfo boundParams)
 	result->invalItems = glob->invalItems;
 	result->nParamExec = glob->nParamExec;
 	result->hasRowSecurity = glob->hasRowSecurity;
+	result->parallelModeNeeded = glob->parallelModeNeeded;
 
 	return result;
 }
@@ -1649,6 +1750,23 @@ grouping_planner(PlannerInfo *root, double tuple_fraction)
 			}
 		}
 
+		/*
+		 * If all that's left to do is the ORDER BY, a path sorted on just a
+		 * prefix of it might be cheaper still, when finished off with an
+		 * incremental sort.
+		 */
+		if (enable_incrementalsort && root->sort_pathkeys != NIL &&
+			root->query_pathkeys == root->sort_pathkeys &&
+			!parse->groupClause && !parse->groupingSets &&
+			!parse->distinctClause && !parse->hasAggs &&
+			!root->hasHavingQual && !activeWindows)
+			sorted_path = choose_incremental_sort_path(root, final_rel,
+													   tuple_fraction,
+													   path_rows,
+													   path_width,
+													   cheapest_path,
+													   sorted_path);
+
 		/*
 		 * Consider whether we want to use hashing instead of sorting.
 		 */
@@ -1656,13 +1774,18 @@ grouping_planner(PlannerInfo *root, double tuple_fraction)
 		{
 			/*
 			 * If grouping, decide whether to use sorted or hashed grouping.
-			 * If grouping sets are present, we can currently do only sorted
-			 * grouping.
 			 */
 
 			if (parse->groupingSets)
 			{
-				use_hashed_grouping = false;
+				use_hashed_grouping =
+					choose_hashed_grouping_sets(root,
+												tuple_fraction, limit_tuples,
+												path_rows, path_width,
+												cheapest_path, sorted_path,
+												rollup_groupclauses,
+												rollup_lists,
+												dNumGroups, &agg_costs);
 			}
 			else
 			{
@@ -1718,11 +1841,51 @@ grouping_planner(PlannerInfo *root, double tuple_fraction)
 												 tlist,
 												 &agg_costs,
 												 best_path);
+
+		/*
+		 * Failing that, see whether it's cheaper to aggregate in parallel
+		 * workers and combine their partial results.
+		 */
+		if (result_plan == NULL)
+			result_plan = make_parallel_agg_plan(root, final_rel,
+												 tlist, sub_tlist,
+												 &agg_costs,
+												 numGroupCols, groupColIdx,
+												 dNumGroups,
+												 use_hashed_grouping,
+												 best_path);
+
+		/*
+		 * Or see whether grouping each member of an inheritance tree on its
+		 * own is cheaper.
+		 */
+		if (result_plan == NULL)
+			result_plan = make_partitionwise_agg_plan(root, final_rel,
+													  tlist, sub_tlist,
+													  &agg_costs,
+													  numGroupCols,
+													  groupColIdx,
+													  dNumGroups,
+													  use_hashed_grouping,
+													  best_path);
+
+		/*
+		 * Or, if all the tables are foreign tables on one server, let its
+		 * FDW compute the aggregates remotely.
+		 */
+		if (result_plan == NULL)
+			result_plan = make_foreign_agg_plan(root, final_rel, tlist,
+												&agg_costs,
+												numGroupCols, dNumGroups,
+												use_hashed_grouping,
+												best_path);
+
 		if (result_plan != NULL)
 		{
 			/*
-			 * optimize_minmax_aggregates generated the full plan, with the
-			 * right tlist, and it has no sort order.
+			 * optimize_minmax_aggregates, make_parallel_agg_plan,
+			 * make_partitionwise_agg_plan or make_foreign_agg_plan generated
+			 * the full plan, with the right tlist, and it has no sort order.
 			 */
 			current_pathkeys = NIL;
 		}
@@ -1826,7 +1989,21 @@ grouping_planner(PlannerInfo *root, double tuple_fraction)
 			 *
 			 * HAVING clause, if any, becomes qual of the Agg or Group node.
 			 */
-			if (use_hashed_grouping)
+			if (use_hashed_grouping && parse->groupingSets)
+			{
+				/* One hash table per grouping set --- no sort needed */
+				result_plan = build_hashed_grouping_sets(root,
+														 parse,
+														 tlist,
+														 rollup_groupclauses,
+														 rollup_lists,
+														 &agg_costs,
+														 path_rows,
+														 result_plan);
+				/* Hashed aggregation produces randomly-ordered results */
+				current_pathkeys = NIL;
+			}
+			else if (use_hashed_grouping)
 			{
 				/* Hashed aggregate plan --- no sort needed */
 				result_plan = (Plan *) make_agg(root,
@@ -1839,6 +2016,8 @@ grouping_planner(PlannerInfo *root, double tuple_fraction)
 									extract_grouping_ops(parse->groupClause),
 												NIL,
 												numGroups,
+												false,
+												true,
 												result_plan);
 				/* Hashed aggregation produces randomly-ordered results */
 				current_pathkeys = NIL;
@@ -2035,8 +2214,29 @@ grouping_planner(PlannerInfo *root, double tuple_fraction)
 					if (!pathkeys_contained_in(window_pathkeys,
 											   current_pathkeys))
 					{
-						/* we do indeed need to sort */
-						result_plan = (Plan *) sort_plan;
+						int			presorted_keys;
+
+						/*
+						 * We do indeed need to sort.  If the previous window
+						 * left the input sorted by a prefix of what this one
+						 * needs, as when only the ORDER BY differs between
+						 * windows with the same PARTITION BY, an incremental
+						 * sort may do.  Build it over the Sort's input, which
+						 * already has any resjunk columns the sort needs.
+						 */
+						presorted_keys = pathkeys_common(window_pathkeys,
+														 current_pathkeys);
+						if (use_incremental_sort(root, sort_plan->plan.lefttree,
+												 window_pathkeys,
+												 presorted_keys, -1.0))
+							result_plan = (Plan *)
+								make_incrementalsort_from_pathkeys(root,
+												   sort_plan->plan.lefttree,
+															window_pathkeys,
+															  presorted_keys,
+																   -1.0);
+						else
+							result_plan = (Plan *) sort_plan;
 						current_pathkeys = window_pathkeys;
 					}
 					/* In either case, extract the per-column information */
@@ -2150,6 +2350,8 @@ grouping_planner(PlannerInfo *root, double tuple_fraction)
 								 extract_grouping_ops(parse->distinctClause),
 											NIL,
 											numDistinctRows,
+											false,
+											true,
 											result_plan);
 			/* Hashed aggregation produces randomly-ordered results */
 			current_pathkeys = NIL;
@@ -2210,10 +2412,23 @@ grouping_planner(PlannerInfo *root, double tuple_fraction)
 	{
 		if (!pathkeys_contained_in(root->sort_pathkeys, current_pathkeys))
 		{
-			result_plan = (Plan *) make_sort_from_pathkeys(root,
-														   result_plan,
+			int			presorted_keys;
+
+			presorted_keys = pathkeys_common(root->sort_pathkeys,
+											 current_pathkeys);
+			if (use_incremental_sort(root, result_plan, root->sort_pathkeys,
+									 presorted_keys, limit_tuples))
+				result_plan = (Plan *)
+					make_incrementalsort_from_pathkeys(root,
+													   result_plan,
+													   root->sort_pathkeys,
+													   presorted_keys,
+													   limit_tuples);
+			else
+				result_plan = (Plan *) make_sort_from_pathkeys(root,
+															   result_plan,
 														 root->sort_pathkeys,
-														   limit_tuples);
+															   limit_tuples);
 			current_pathkeys = root->sort_pathkeys;
 		}
 	}
@@ -2388,6 +2603,8 @@ build_grouping_chain(PlannerInfo *root,
 									 extract_grouping_ops(groupClause),
 									 gsets,
 									 numGroups,
+									 false,
+									 true,
 									 sort_plan);
 
 		sort_plan->lefttree = NULL;
@@ -2424,6 +2641,8 @@ build_grouping_chain(PlannerInfo *root,
 										extract_grouping_ops(groupClause),
 										gsets,
 										numGroups,
+										false,
+										true,
 										result_plan);
 
 		((Agg *) result_plan)->chain = chain;
@@ -2451,6 +2670,118 @@ build_grouping_chain(PlannerInfo *root,
 	return result_plan;
 }
 
+/*
+ * Build Agg nodes to implement hashed grouping with one or more grouping
+ * sets.  Each grouping set gets its own AGG_HASHED node, with its grouping
+ * columns in grpColIdx and a single grouping set listing all of them.  The
+ * node for the first set of the last rollup is the one returned; the others
+ * are attached as its chain, like build_grouping_chain does, but since they
+ * all share the top node's input they have no Sort nodes below them.
+ */
+static Plan *
+build_hashed_grouping_sets(PlannerInfo *root,
+						   Query *parse,
+						   List *tlist,
+						   List *rollup_groupclauses,
+						   List *rollup_lists,
+						   AggClauseCosts *agg_costs,
+						   double path_rows,
+						   Plan *result_plan)
+{
+	Agg		   *top_agg = NULL;
+	List	   *chain = NIL;
+	double		dNumGroups = 0;
+	ListCell   *lc,
+			   *lc2;
+
+	forboth(lc, rollup_groupclauses, lc2, rollup_lists)
+	{
+		List	   *groupClause = (List *) lfirst(lc);
+		List	   *groupExprs;
+		ListCell   *lc3;
+
+		groupExprs = get_sortgrouplist_exprs(groupClause, parse->targetList);
+
+		foreach(lc3, (List *) lfirst(lc2))
+		{
+			List	   *gset = (List *) lfirst(lc3);
+			int			numGroupCols = list_length(gset);
+			AttrNumber *grpColIdx;
+			Oid		   *grpOperators;
+			List	   *new_gset = NIL;
+			double		numGroups;
+			Agg		   *agg;
+			ListCell   *lc4;
+			int			i = 0;
+
+			grpColIdx = palloc(sizeof(AttrNumber) * Max(numGroupCols, 1));
+			grpOperators = palloc(sizeof(Oid) * Max(numGroupCols, 1));
+
+			foreach(lc4, gset)
+			{
+				SortGroupClause *gc = list_nth(groupClause, lfirst_int(lc4));
+
+				grpColIdx[i] = root->grouping_map[gc->tleSortGroupRef];
+				grpOperators[i] = gc->eqop;
+				new_gset = lappend_int(new_gset, i);
+				i++;
+			}
+
+			numGroups = estimate_num_groups(root, groupExprs, path_rows,
+											&gset);
+			dNumGroups += numGroups;
+
+			agg = make_agg(root,
+						   tlist,
+						   (List *) parse->havingQual,
+						   AGG_HASHED,
+						   agg_costs,
+						   numGroupCols,
+						   grpColIdx,
+						   grpOperators,
+						   list_make1(new_gset),
+						   (long) Min(numGroups, (double) LONG_MAX),
+						   false,
+						   true,
+						   result_plan);
+
+			if (lnext(lc) == NULL && top_agg == NULL)
+				top_agg = agg;
+			else
+				chain = lappend(chain, agg);
+		}
+	}
+
+	Assert(top_agg != NULL);
+	top_agg->chain = chain;
+
+	/*
+	 * Add the costs of the other grouping sets, less the input which they
+	 * don't actually run again.  All the hash tables are filled before the
+	 * first group is returned, so their startup costs count as well.
+	 */
+	foreach(lc, chain)
+	{
+		Plan	   *subplan = lfirst(lc);
+
+		top_agg->plan.startup_cost += subplan->startup_cost -
+			result_plan->total_cost;
+		top_agg->plan.total_cost += subplan->total_cost -
+			result_plan->total_cost;
+
+		/*
+		 * Nuke stuff we don't need to avoid bloating debug output.
+		 */
+		subplan->targetlist = NIL;
+		subplan->qual = NIL;
+		subplan->lefttree = NULL;
+	}
+
+	top_agg->plan.plan_rows = dNumGroups;
+
+	return (Plan *) top_agg;
+}
+
 /*
  * add_tlist_costs_to_plan
  *
@@ -3516,7 +3847,8 @@ choose_hashed_grouping(PlannerInfo *root,
 
 	/*
 	 * Don't do it if it doesn't look like the hashtable will fit into
-	 * work_mem.
+	 * work_mem.  The executor copes if it doesn't, by spilling groups to
+	 * disk, but our cost model doesn't account for that.
 	 */
 
 	/* Estimate per-hash-entry space at tuple width... */
@@ -3616,6 +3948,182 @@ choose_hashed_grouping(PlannerInfo *root,
 	return false;
 }
 
+/*
+ * choose_hashed_grouping_sets - should we use hashing for grouping sets?
+ *
+ * This is the counterpart of choose_hashed_grouping for queries with
+ * grouping sets.  Hashing computes all the grouping sets in one pass over
+ * the unsorted input, using a separate hash table for each set, while
+ * sorting needs another sort of the input for each rollup but the first.
+ *
+ * Returns TRUE to select hashing, FALSE to select sorting.
+ */
+static bool
+choose_hashed_grouping_sets(PlannerInfo *root,
+							double tuple_fraction, double limit_tuples,
+							double path_rows, int path_width,
+							Path *cheapest_path, Path *sorted_path,
+							List *rollup_groupclauses, List *rollup_lists,
+							double dNumGroups, AggClauseCosts *agg_costs)
+{
+	Query	   *parse = root->parse;
+	bool		can_hash;
+	bool		can_sort;
+	Size		hashentrysize;
+	List	   *target_pathkeys;
+	List	   *current_pathkeys;
+	Path		hashed_p;
+	Path		sorted_p;
+	Path		agg_p;
+	ListCell   *lc,
+			   *lc2;
+
+	/* Same restrictions on hashing as for plain grouping */
+	can_hash = (agg_costs->numOrderedAggs == 0 &&
+				grouping_is_hashable(parse->groupClause));
+	can_sort = grouping_is_sortable(parse->groupClause);
+
+	/*
+	 * Quick out if only one choice is workable.  If neither is, let the
+	 * sorted code path complain.
+	 */
+	if (!(can_hash && can_sort))
+		return can_hash;
+
+	/* Prefer sorting when enable_hashagg is off */
+	if (!enable_hashagg)
+		return false;
+
+	/*
+	 * Don't do it if it doesn't look like all the hash tables together will
+	 * fit into work_mem; see choose_hashed_grouping.
+	 */
+	hashentrysize = MAXALIGN(path_width) + MAXALIGN(SizeofMinimalTupleHeader);
+	hashentrysize += agg_costs->transitionSpace;
+	hashentrysize += hash_agg_entry_size(agg_costs->numAggs);
+
+	if (hashentrysize * dNumGroups > work_mem * 1024L)
+		return false;
+
+	if (list_length(root->distinct_pathkeys) >
+		list_length(root->sort_pathkeys))
+		target_pathkeys = root->distinct_pathkeys;
+	else
+		target_pathkeys = root->sort_pathkeys;
+
+	/*
+	 * We need to consider cheapest_path + one hashagg per grouping set [+
+	 * final sort] versus either cheapest_path or presorted_path [+ sort] +
+	 * agg, plus a sort and agg for each additional rollup [+ final sort].
+	 * Every input tuple is processed once for each grouping set either way.
+	 * The hash tables must all be filled before the first group is
+	 * returned, whereas the additional rollups of the sorted plan only add
+	 * to its total cost, as in build_grouping_chain.
+	 */
+	hashed_p.startup_cost = cheapest_path->total_cost;
+	hashed_p.total_cost = cheapest_path->total_cost;
+
+	sorted_p.startup_cost = 0;
+	sorted_p.total_cost = 0;
+
+	forboth(lc, rollup_groupclauses, lc2, rollup_lists)
+	{
+		List	   *groupClause = (List *) lfirst(lc);
+		List	   *gsets = (List *) lfirst(lc2);
+		List	   *groupExprs;
+		double		rollupGroups = 0;
+		ListCell   *lc3;
+
+		groupExprs = get_sortgrouplist_exprs(groupClause, parse->targetList);
+
+		foreach(lc3, gsets)
+		{
+			List	   *gset = (List *) lfirst(lc3);
+			double		numGroups;
+
+			numGroups = estimate_num_groups(root, groupExprs, path_rows,
+											&gset);
+			rollupGroups += numGroups;
+
+			cost_agg(&agg_p, root, AGG_HASHED, agg_costs,
+					 list_length(gset), numGroups,
+					 0.0, 0.0, path_rows);
+			hashed_p.startup_cost += agg_p.startup_cost;
+			hashed_p.total_cost += agg_p.total_cost;
+		}
+
+		/* The last rollup is the one the input may already be sorted for */
+		if (lnext(lc) == NULL)
+			break;
+
+		cost_sort(&agg_p, root, NIL, 0.0,
+				  path_rows, path_width,
+				  0.0, work_mem, -1.0);
+		cost_agg(&agg_p, root, AGG_SORTED, agg_costs,
+				 list_length(linitial(gsets)), rollupGroups,
+				 agg_p.startup_cost, agg_p.total_cost,
+				 path_rows);
+		sorted_p.total_cost += agg_p.total_cost;
+	}
+
+	/* Result of hashed agg is always unsorted */
+	if (target_pathkeys)
+		cost_sort(&hashed_p, root, target_pathkeys, hashed_p.total_cost,
+				  dNumGroups, path_width,
+				  0.0, work_mem, limit_tuples);
+
+	/* Now the top rollup of the sorted plan */
+	if (sorted_path)
+	{
+		agg_p.startup_cost = sorted_path->startup_cost;
+		agg_p.total_cost = sorted_path->total_cost;
+		current_pathkeys = sorted_path->pathkeys;
+	}
+	else
+	{
+		agg_p.startup_cost = cheapest_path->startup_cost;
+		agg_p.total_cost = cheapest_path->total_cost;
+		current_pathkeys = cheapest_path->pathkeys;
+	}
+	if (!pathkeys_contained_in(root->group_pathkeys, current_pathkeys))
+		cost_sort(&agg_p, root, root->group_pathkeys, agg_p.total_cost,
+				  path_rows, path_width,
+				  0.0, work_mem, -1.0);
+	cost_agg(&agg_p, root, AGG_SORTED, agg_costs,
+			 list_length(linitial((List *) llast(rollup_lists))),
+			 dNumGroups,
+			 agg_p.startup_cost, agg_p.total_cost,
+			 path_rows);
+	sorted_p.startup_cost += agg_p.startup_cost;
+	sorted_p.total_cost += agg_p.total_cost;
+
+	/*
+	 * Output is in sorted order by group_pathkeys only for a single rollup
+	 * on a non-empty list of grouping expressions.
+	 */
+	if (list_length(rollup_groupclauses) == 1 &&
+		list_length(linitial(rollup_groupclauses)) > 0)
+		current_pathkeys = root->group_pathkeys;
+	else
+		current_pathkeys = NIL;
+	if (target_pathkeys &&
+		!pathkeys_contained_in(target_pathkeys, current_pathkeys))
+		cost_sort(&sorted_p, root, target_pathkeys, sorted_p.total_cost,
+				  dNumGroups, path_width,
+				  0.0, work_mem, limit_tuples);
+
+	/*
+	 * Now make the decision using the top-level tuple fraction.
+	 */
+	if (compare_fractional_path_costs(&hashed_p, &sorted_p,
+									  tuple_fraction) < 0)
+	{
+		/* Hashed is cheaper, so use it */
+		return true;
+	}
+	return false;
+}
+
 /*
  * choose_hashed_distinct - should we use hashing for DISTINCT?
  *
@@ -3767,6 +4275,720 @@ choose_hashed_distinct(PlannerInfo *root,
 	return false;
 }
 
+/*
+ * choose_incremental_sort_path
+ *		Look for a path sorted by a prefix of the ORDER BY keys that would be
+ *		cheaper, with an incremental sort on top, than sorted_path (if any)
+ *		or the cheapest path plus a full sort.
+ *
+ * Returns the path to use as the presorted path, which may still be
+ * sorted_path or NULL if nothing better was found.
+ */
+static Path *
+choose_incremental_sort_path(PlannerInfo *root, RelOptInfo *final_rel,
+							 double tuple_fraction,
+							 double path_rows, int path_width,
+							 Path *cheapest_path, Path *sorted_path)
+{
+	List	   *pathkeys = root->sort_pathkeys;
+	Path		best_p;			/* dummy for cost of the best plan so far */
+	Path	   *best_path = sorted_path;
+	ListCell   *lc;
+
+	/* Nothing to gain if the cheapest path is fully sorted already */
+	if (pathkeys_contained_in(pathkeys, cheapest_path->pathkeys))
+		return sorted_path;
+
+	if (sorted_path)
+	{
+		best_p.startup_cost = sorted_path->startup_cost;
+		best_p.total_cost = sorted_path->total_cost;
+	}
+	else
+		cost_sort(&best_p, root, pathkeys, cheapest_path->total_cost,
+				  path_rows, path_width, 0.0, work_mem, root->limit_tuples);
+
+	foreach(lc, final_rel->pathlist)
+	{
+		Path	   *path = (Path *) lfirst(lc);
+		Path		incsort_p;	/* dummy for result of cost_incremental_sort */
+		int			presorted_keys;
+
+		if (PATH_REQ_OUTER(path) != NULL)
+			continue;
+
+		presorted_keys = pathkeys_common(pathkeys, path->pathkeys);
+		if (presorted_keys == 0 || presorted_keys >= list_length(pathkeys))
+			continue;
+
+		cost_incremental_sort(&incsort_p, root, pathkeys, presorted_keys,
+							  path->startup_cost, path->total_cost,
+							  path_rows, path_width,
+							  0.0, work_mem, root->limit_tuples);
+		if (compare_fractional_path_costs(&incsort_p, &best_p,
+										  tuple_fraction) < 0)
+		{
+			best_p.startup_cost = incsort_p.startup_cost;
+			best_p.total_cost = incsort_p.total_cost;
+			best_path = path;
+		}
+	}
+
+	return best_path;
+}
+
+/*
+ * use_incremental_sort
+ *		Decide whether to sort the output of lefttree, which is already
+ *		sorted by the first presorted_keys of pathkeys, with an incremental
+ *		sort rather than a full one.
+ */
+static bool
+use_incremental_sort(PlannerInfo *root, Plan *lefttree, List *pathkeys,
+					 int presorted_keys, double limit_tuples)
+{
+	Path		sort_p;			/* dummy for result of cost_sort */
+	Path		incsort_p;		/* dummy for result of cost_incremental_sort */
+	double		fraction;
+
+	if (!enable_incrementalsort || presorted_keys == 0 ||
+		presorted_keys >= list_length(pathkeys))
+		return false;
+
+	cost_sort(&sort_p, root, pathkeys, lefttree->total_cost,
+			  lefttree->plan_rows, lefttree->plan_width,
+			  0.0, work_mem, limit_tuples);
+	cost_incremental_sort(&incsort_p, root, pathkeys, presorted_keys,
+						  lefttree->startup_cost, lefttree->total_cost,
+						  lefttree->plan_rows, lefttree->plan_width,
+						  0.0, work_mem, limit_tuples);
+
+	/* Judge by the fraction of the output a LIMIT will fetch, if any */
+	if (limit_tuples > 0 && lefttree->plan_rows > 0)
+		fraction = limit_tuples / lefttree->plan_rows;
+	else
+		fraction = 1.0;
+
+	return compare_fractional_path_costs(&incsort_p, &sort_p, fraction) < 0;
+}
+
+/*
+ * make_parallel_agg_plan
+ *	  Try to build a plan that aggregates in parallel workers.
+ *
+ * Each worker (and the leader) runs a partial Agg over a parallel-aware
+ * scan of final_rel, emitting transition states rather than final values.
+ * A Gather collects those, and a finalizing Agg above it merges the states
+ * with the aggregates' combine functions and computes the results.
+ *
+ * Returns NULL if this isn't possible for the query, or if it's estimated to
+ * be more expensive than aggregating best_path in the leader alone.  On
+ * success, the returned plan computes 'tlist' and applies the HAVING qual,
+ * and its output has no particular sort order.
+ */
+static Plan *
+make_parallel_agg_plan(PlannerInfo *root, RelOptInfo *final_rel,
+					   List *tlist, List *sub_tlist,
+					   const AggClauseCosts *agg_costs,
+					   int numGroupCols, AttrNumber *groupColIdx,
+					   double dNumGroups, bool use_hashed_grouping,
+					   Path *best_path)
+{
+	Query	   *parse = root->parse;
+	AggStrategy aggstrategy;
+	Path	   *partial_path;
+	int			parallel_degree;
+	double		dNumPartialGroups;
+	double		gather_rows;
+	Path		serial_p;
+	Path		partial_p;
+	Path		final_p;
+	Cost		gather_startup_cost;
+	Cost		gather_total_cost;
+	partial_agg_context context;
+	List	   *partial_tlist;
+	List	   *final_tlist;
+	List	   *final_having;
+	Plan	   *result_plan;
+	Plan	   *partial_plan;
+	Gather	   *gather_plan;
+	Oid		   *grpOperators;
+
+	/*
+	 * We only handle plain aggregation and hashed grouping over a single
+	 * parallel-safe relation.  Grouping sets, sorted grouping and window
+	 * functions would have to be made to cope with the extra plan levels.
+	 */
+	if (!parse->hasAggs || parse->groupingSets || parse->hasWindowFuncs)
+		return NULL;
+	if (parse->groupClause && !use_hashed_grouping)
+		return NULL;
+	if (!root->glob->parallelModeOK || final_rel->partial_pathlist == NIL)
+		return NULL;
+
+	/*
+	 * All the expressions we push down must be safe to run in a worker, and
+	 * every aggregate must be able to combine partial states.
+	 */
+	if (has_parallel_hazard((Node *) tlist, false) ||
+		has_parallel_hazard(parse->havingQual, false))
+		return NULL;
+	if (!aggregates_are_combinable((Node *) tlist) ||
+		!aggregates_are_combinable(parse->havingQual))
+		return NULL;
+
+	aggstrategy = parse->groupClause ? AGG_HASHED : AGG_PLAIN;
+	partial_path = (Path *) linitial(final_rel->partial_pathlist);
+	parallel_degree = partial_path->parallel_degree;
+
+	/*
+	 * Estimate the cost of aggregating the whole relation in the leader, for
+	 * comparison.
+	 */
+	cost_agg(&serial_p, root, aggstrategy, agg_costs,
+			 numGroupCols, dNumGroups,
+			 best_path->startup_cost, best_path->total_cost,
+			 final_rel->rows);
+
+	/*
+	 * Each participant, including the leader, produces at most one partial
+	 * group per final group, and no more groups than the tuples it reads.
+	 */
+	if (aggstrategy == AGG_PLAIN)
+		dNumPartialGroups = 1;
+	else
+		dNumPartialGroups = Min(dNumGroups, partial_path->rows);
+
+	cost_agg(&partial_p, root, aggstrategy, agg_costs,
+			 numGroupCols, dNumPartialGroups,
+			 partial_path->startup_cost, partial_path->total_cost,
+			 partial_path->rows);
+
+	gather_rows = dNumPartialGroups * (parallel_degree + 1);
+	gather_startup_cost = partial_p.startup_cost + parallel_setup_cost;
+	gather_total_cost = partial_p.total_cost + parallel_setup_cost +
+		parallel_tuple_cost * gather_rows;
+
+	cost_agg(&final_p, root, aggstrategy, agg_costs,
+			 numGroupCols, dNumGroups,
+			 gather_startup_cost, gather_total_cost,
+			 gather_rows);
+
+	if (final_p.total_cost >= serial_p.total_cost)
+		return NULL;
+
+	/*
+	 * OK, build the plan.  The scan emits the same tlist it would have in a
+	 * serial plan; the partial Agg passes the scan's columns through and
+	 * appends one transition-state column per distinct aggregate, so the
+	 * grouping column numbers are valid at every level.
+	 */
+	result_plan = create_plan(root, partial_path);
+	result_plan->targetlist = sub_tlist;
+	add_tlist_costs_to_plan(root, result_plan, sub_tlist);
+
+	context.partial_tlist = (List *) copyObject(sub_tlist);
+	final_tlist = (List *) make_final_agg_expr_mutator((Node *) tlist,
+													   &context);
+	final_having = (List *) make_final_agg_expr_mutator(parse->havingQual,
+														&context);
+	partial_tlist = context.partial_tlist;
+
+	grpOperators = extract_grouping_ops(parse->groupClause);
+
+	partial_plan = (Plan *) make_agg(root,
+									 partial_tlist,
+									 NIL,
+									 aggstrategy,
+									 agg_costs,
+									 numGroupCols,
+									 groupColIdx,
+									 grpOperators,
+									 NIL,
+									 (long) Min(dNumPartialGroups,
+												(double) LONG_MAX),
+									 false,
+									 false,
+									 result_plan);
+
+	gather_plan = make_gather((List *) copyObject(partial_tlist),
+							  NIL,
+							  parallel_degree,
+							  partial_plan);
+	gather_plan->plan.startup_cost = gather_startup_cost;
+	gather_plan->plan.total_cost = gather_total_cost;
+	gather_plan->plan.plan_rows = gather_rows;
+	gather_plan->plan.plan_width = partial_plan->plan_width;
+
+	/* use parallel mode for parallel plans. */
+	root->glob->parallelModeNeeded = true;
+
+	return (Plan *) make_agg(root,
+							 final_tlist,
+							 final_having,
+							 aggstrategy,
+							 agg_costs,
+							 numGroupCols,
+							 groupColIdx,
+							 grpOperators,
+							 NIL,
+							 (long) Min(dNumGroups, (double) LONG_MAX),
+							 true,
+							 true,
+							 (Plan *) gather_plan);
+}
+
+/*
+ * make_partitionwise_agg_plan
+ *	  Try to build a plan that groups each member of an inheritance tree
+ *	  on its own.
+ *
+ * If one of the GROUP BY columns is a column of the parent table whose
+ * values the members' CHECK constraints keep apart, no group can draw rows
+ * from two members.  Each member can then be grouped and aggregated
+ * completely, and an Append of the results is the final answer, with no
+ * combining step.  The members' inputs are cheaper to sort one at a time,
+ * and a hash table too big for work_mem over the whole tree may fit for
+ * each member.
+ *
+ * Returns NULL if this isn't possible for the query, or if it's estimated to
+ * be more expensive than grouping best_path as a whole.  On success, the
+ * returned plan computes 'tlist' and applies the HAVING qual, and its output
+ * has no particular sort order.
+ */
+static Plan *
+make_partitionwise_agg_plan(PlannerInfo *root, RelOptInfo *final_rel,
+							List *tlist, List *sub_tlist,
+							const AggClauseCosts *agg_costs,
+							int numGroupCols, AttrNumber *groupColIdx,
+							double dNumGroups, bool use_hashed_grouping,
+							Path *best_path)
+{
+	Query	   *parse = root->parse;
+	RangeTblEntry *rte;
+	AppendPath *append_path;
+	List	   *member_rels = NIL;
+	bool		disjoint = false;
+	bool		can_hash;
+	bool		can_sort;
+	bool	   *member_hashed;
+	double	   *member_groups;
+	Path		serial_p;
+	Cost		partitionwise_cost;
+	Oid		   *grpOperators;
+	List	   *subplans = NIL;
+	ListCell   *lc;
+	int			i;
+
+	if (!enable_partitionwise_aggregate)
+		return NULL;
+	if (!parse->groupClause || parse->groupingSets || parse->hasWindowFuncs)
+		return NULL;
+
+	/* We need a plain inheritance tree, scanned with an Append */
+	if (final_rel->reloptkind != RELOPT_BASEREL)
+		return NULL;
+	rte = planner_rt_fetch(final_rel->relid, root);
+	if (rte->rtekind != RTE_RELATION || !rte->inh)
+		return NULL;
+	if (!IsA(final_rel->cheapest_total_path, AppendPath))
+		return NULL;
+	append_path = (AppendPath *) final_rel->cheapest_total_path;
+	if (append_path->subpaths == NIL)
+		return NULL;
+
+	/* Each member gets its own copy of these, which subplans can't have */
+	if (contain_subplans((Node *) tlist) ||
+		contain_subplans(parse->havingQual))
+		return NULL;
+
+	foreach(lc, append_path->subpaths)
+		member_rels = lappend(member_rels, ((Path *) lfirst(lc))->parent);
+
+	/* Look for a grouping column whose values the members keep apart */
+	foreach(lc, parse->groupClause)
+	{
+		SortGroupClause *sgc = (SortGroupClause *) lfirst(lc);
+		Var		   *var = (Var *) get_sortgroupclause_expr(sgc, tlist);
+
+		if (IsA(var, Var) &&
+			var->varno == final_rel->relid &&
+			var->varlevelsup == 0 &&
+			var->varattno > 0 &&
+			appendrel_members_disjoint(root, final_rel->relid,
+									   var->varattno, member_rels))
+		{
+			disjoint = true;
+			break;
+		}
+	}
+	if (!disjoint)
+		return NULL;
+
+	/*
+	 * Estimate the cost of grouping best_path as a whole, the way
+	 * grouping_planner will do it, for comparison.
+	 */
+	if (use_hashed_grouping)
+		cost_agg(&serial_p, root, AGG_HASHED, agg_costs,
+				 numGroupCols, dNumGroups,
+				 best_path->startup_cost, best_path->total_cost,
+				 best_path->rows);
+	else
+		cost_sorted_grouping(root, &serial_p, best_path, final_rel->width,
+							 agg_costs, numGroupCols, dNumGroups);
+
+	/*
+	 * Choose between hashing and sorting for each member on its own, like
+	 * choose_hashed_grouping does for the whole.
+	 */
+	can_hash = (agg_costs->numOrderedAggs == 0 &&
+				grouping_is_hashable(parse->groupClause));
+	can_sort = grouping_is_sortable(parse->groupClause);
+
+	member_hashed = (bool *) palloc(list_length(member_rels) * sizeof(bool));
+	member_groups = (double *) palloc(list_length(member_rels) * sizeof(double));
+	partitionwise_cost = 0;
+	i = 0;
+	foreach(lc, append_path->subpaths)
+	{
+		Path	   *subpath = (Path *) lfirst(lc);
+		AppendRelInfo *appinfo;
+		List	   *groupExprs;
+		Size		hashentrysize;
+		Path		hashed_p;
+		Path		sorted_p;
+
+		appinfo = find_childrel_appendrelinfo(root, subpath->parent);
+		groupExprs = (List *)
+			adjust_appendrel_attrs(root,
+								   (Node *) get_sortgrouplist_exprs(parse->groupClause,
+																	tlist),
+								   appinfo);
+		member_groups[i] = estimate_num_groups(root, groupExprs,
+											   subpath->rows, NULL);
+
+		hashentrysize = MAXALIGN(subpath->parent->width) +
+			MAXALIGN(SizeofMinimalTupleHeader);
+		hashentrysize += agg_costs->transitionSpace;
+		hashentrysize += hash_agg_entry_size(agg_costs->numAggs);
+
+		if (can_hash)
+			cost_agg(&hashed_p, root, AGG_HASHED, agg_costs,
+					 numGroupCols, member_groups[i],
+					 subpath->startup_cost, subpath->total_cost,
+					 subpath->rows);
+		if (can_sort)
+			cost_sorted_grouping(root, &sorted_p, subpath,
+								 subpath->parent->width,
+								 agg_costs, numGroupCols, member_groups[i]);
+
+		if (!can_sort)
+			member_hashed[i] = true;
+		else if (!can_hash || !enable_hashagg ||
+				 hashentrysize * member_groups[i] > work_mem * 1024L)
+			member_hashed[i] = false;
+		else
+			member_hashed[i] = (hashed_p.total_cost < sorted_p.total_cost);
+
+		partitionwise_cost += member_hashed[i] ?
+			hashed_p.total_cost : sorted_p.total_cost;
+		i++;
+	}
+
+	if (partitionwise_cost >= serial_p.total_cost)
+		return NULL;
+
+	/*
+	 * OK, build the plan.  Each member's scan emits the member's version of
+	 * sub_tlist, so the grouping column numbers are valid for all of them.
+	 */
+	grpOperators = extract_grouping_ops(parse->groupClause);
+	i = 0;
+	foreach(lc, append_path->subpaths)
+	{
+		Path	   *subpath = (Path *) lfirst(lc);
+		AppendRelInfo *appinfo;
+		List	   *member_tlist;
+		List	   *member_sub_tlist;
+		List	   *member_having;
+		long		numGroups;
+		Plan	   *plan;
+
+		appinfo = find_childrel_appendrelinfo(root, subpath->parent);
+		member_tlist = (List *)
+			adjust_appendrel_attrs(root, (Node *) tlist, appinfo);
+		member_sub_tlist = (List *)
+			adjust_appendrel_attrs(root, (Node *) sub_tlist, appinfo);
+		member_having = (List *)
+			adjust_appendrel_attrs(root, parse->havingQual, appinfo);
+		numGroups = (long) Min(member_groups[i], (double) LONG_MAX);
+
+		plan = create_plan(root, subpath);
+		if (!is_projection_capable_plan(plan) &&
+			!tlist_same_exprs(member_sub_tlist, plan->targetlist))
+			plan = (Plan *) make_result(root, member_sub_tlist, NULL, plan);
+		else
+			plan->targetlist = member_sub_tlist;
+		add_tlist_costs_to_plan(root, plan, member_sub_tlist);
+
+		if (member_hashed[i])
+			plan = (Plan *) make_agg(root,
+									 member_tlist,
+									 member_having,
+									 AGG_HASHED,
+									 agg_costs,
+									 numGroupCols,
+									 groupColIdx,
+									 grpOperators,
+									 NIL,
+									 numGroups,
+									 false,
+									 true,
+									 plan);
+		else
+		{
+			if (!pathkeys_contained_in(root->group_pathkeys,
+									   subpath->pathkeys))
+				plan = (Plan *) make_sort_from_groupcols(root,
+														 parse->groupClause,
+														 groupColIdx,
+														 plan);
+			if (parse->hasAggs)
+				plan = (Plan *) make_agg(root,
+										 member_tlist,
+										 member_having,
+										 AGG_SORTED,
+										 agg_costs,
+										 numGroupCols,
+										 groupColIdx,
+										 grpOperators,
+										 NIL,
+										 numGroups,
+										 false,
+										 true,
+										 plan);
+			else
+				plan = (Plan *) make_group(root,
+										   member_tlist,
+										   member_having,
+										   numGroupCols,
+										   groupColIdx,
+										   grpOperators,
+										   member_groups[i],
+										   plan);
+		}
+
+		subplans = lappend(subplans, plan);
+		i++;
+	}
+
+	return (Plan *) make_append(subplans, (List *) copyObject(tlist));
+}
+
+/*
+ * cost_sorted_grouping
+ *	  Estimate the cost of grouping input_path by sorting it, if it isn't
+ *	  sorted already, and running a sorted Agg or a Group node over it.
+ */
+static void
+cost_sorted_grouping(PlannerInfo *root, Path *result_p,
+					 Path *input_path, int input_width,
+					 const AggClauseCosts *agg_costs,
+					 int numGroupCols, double numGroups)
+{
+	result_p->startup_cost = input_path->startup_cost;
+	result_p->total_cost = input_path->total_cost;
+	if (!pathkeys_contained_in(root->group_pathkeys, input_path->pathkeys))
+		cost_sort(result_p, root, root->group_pathkeys,
+				  result_p->total_cost,
+				  input_path->rows, input_width,
+				  0.0, work_mem, -1.0);
+
+	if (root->parse->hasAggs)
+		cost_agg(result_p, root, AGG_SORTED, agg_costs,
+				 numGroupCols, numGroups,
+				 result_p->startup_cost, result_p->total_cost,
+				 input_path->rows);
+	else
+		cost_group(result_p, root, numGroupCols, numGroups,
+				   result_p->startup_cost, result_p->total_cost,
+				   input_path->rows);
+}
+
+/*
+ * make_foreign_agg_plan
+ *	  Try to build a plan that lets the foreign server do the aggregation.
+ *
+ * This is possible when final_rel is a foreign table, or a join the FDW
+ * pushed down, and the FDW provides GetForeignUpperPlan.  It returns a
+ * ForeignScan emitting tlist, with the HAVING quals applied, or NULL if it
+ * can't compute the grouped result; we use it if it's estimated cheaper
+ * than aggregating best_path locally.
+ */
+static Plan *
+make_foreign_agg_plan(PlannerInfo *root, RelOptInfo *final_rel,
+					  List *tlist,
+					  const AggClauseCosts *agg_costs,
+					  int numGroupCols, double dNumGroups,
+					  bool use_hashed_grouping, Path *best_path)
+{
+	Query	   *parse = root->parse;
+	ForeignScan *fscan;
+	AggStrategy aggstrategy;
+	Path		local_p;
+
+	/*
+	 * Grouping sets and window functions need plan levels the FDW can't
+	 * provide.
+	 */
+	if (!parse->hasAggs && !parse->groupClause)
+		return NULL;
+	if (parse->groupingSets || parse->hasWindowFuncs)
+		return NULL;
+	if (final_rel->fdwroutine == NULL ||
+		final_rel->fdwroutine->GetForeignUpperPlan == NULL)
+		return NULL;
+
+	fscan = final_rel->fdwroutine->GetForeignUpperPlan(root, final_rel,
+													   tlist, dNumGroups);
+	if (fscan == NULL)
+		return NULL;
+
+	/* Compare with aggregating the best path locally */
+	if (!parse->groupClause)
+		aggstrategy = AGG_PLAIN;
+	else if (use_hashed_grouping)
+		aggstrategy = AGG_HASHED;
+	else
+		aggstrategy = AGG_SORTED;
+	cost_agg(&local_p, root, aggstrategy, agg_costs,
+			 numGroupCols, dNumGroups,
+			 best_path->startup_cost, best_path->total_cost,
+			 final_rel->rows);
+
+	if (fscan->scan.plan.total_cost >= local_p.total_cost)
+		return NULL;
+
+	fscan->fs_server = final_rel->serverid;
+	fscan->fs_relids = bms_copy(final_rel->relids);
+	return (Plan *) fscan;
+}
+
+/*
+ * aggregates_are_combinable
+ *	  Check whether every Aggref in the expression can be computed in
+ *	  partial mode and finished by combining the partial states.
+ *
+ * That requires a plain (not ordered-set) aggregate without DISTINCT or
+ * ORDER BY, with a combine function and a transition type that can be
+ * shipped through a tuple queue: not internal, and not polymorphic, since
+ * the finalizing Agg would have no input expression to resolve it from.
+ */
+static bool
+aggregates_are_combinable(Node *node)
+{
+	return !aggregates_are_combinable_walker(node, NULL);
+}
+
+static bool
+aggregates_are_combinable_walker(Node *node, void *context)
+{
+	if (node == NULL)
+		return false;
+	if (IsA(node, Aggref))
+	{
+		Aggref	   *aggref = (Aggref *) node;
+		HeapTuple	aggTuple;
+		Form_pg_aggregate aggform;
+		bool		result;
+
+		if (aggref->aggorder != NIL || aggref->aggdistinct != NIL ||
+			aggref->aggkind != AGGKIND_NORMAL)
+			return true;
+
+		aggTuple = SearchSysCache1(AGGFNOID,
+								   ObjectIdGetDatum(aggref->aggfnoid));
+		if (!HeapTupleIsValid(aggTuple))
+			elog(ERROR, "cache lookup failed for aggregate %u",
+				 aggref->aggfnoid);
+		aggform = (Form_pg_aggregate) GETSTRUCT(aggTuple);
+
+		result = (!OidIsValid(aggform->aggcombinefn) ||
+				  aggform->aggtranstype == INTERNALOID ||
+				  IsPolymorphicType(aggform->aggtranstype) ||
+				  aggform->aggfinalextra);
+
+		ReleaseSysCache(aggTuple);
+
+		/* no need to examine the aggregate's arguments */
+		return result;
+	}
+	return expression_tree_walker(node, aggregates_are_combinable_walker,
+								  context);
+}
+
+/*
+ * make_final_agg_expr_mutator
+ *	  Convert an expression to be evaluated by the finalizing Agg node of a
+ *	  parallel aggregation plan.
+ *
+ * Each Aggref is replaced by one that takes the matching partial aggregate's
+ * output as its single argument.  The partial Aggref, which returns the
+ * aggregate's transition state, is added to context->partial_tlist if it is
+ * not there already; setrefs.c will later turn the argument into a reference
+ * to that column of the Gather node's output.
+ */
+static Node *
+make_final_agg_expr_mutator(Node *node, partial_agg_context *context)
+{
+	if (node == NULL)
+		return NULL;
+	if (IsA(node, Aggref))
+	{
+		Aggref	   *aggref = (Aggref *) node;
+		Aggref	   *partial;
+		Aggref	   *final;
+		HeapTuple	aggTuple;
+		Form_pg_aggregate aggform;
+
+		/* The partial aggregate returns its transition state */
+		partial = (Aggref *) copyObject(aggref);
+
+		aggTuple = SearchSysCache1(AGGFNOID,
+								   ObjectIdGetDatum(aggref->aggfnoid));
+		if (!HeapTupleIsValid(aggTuple))
+			elog(ERROR, "cache lookup failed for aggregate %u",
+				 aggref->aggfnoid);
+		aggform = (Form_pg_aggregate) GETSTRUCT(aggTuple);
+		partial->aggtype = aggform->aggtranstype;
+		ReleaseSysCache(aggTuple);
+
+		if (!tlist_member((Node *) partial, context->partial_tlist))
+			context->partial_tlist =
+				lappend(context->partial_tlist,
+						makeTargetEntry((Expr *) partial,
+										list_length(context->partial_tlist) + 1,
+										NULL,
+										false));
+
+		/*
+		 * The finalizing aggregate's only input is the partial state.  Any
+		 * FILTER was already applied by the partial aggregate.
+		 */
+		final = (Aggref *) copyObject(aggref);
+		final->args = list_make1(makeTargetEntry((Expr *) copyObject(partial),
+												 1, NULL, false));
+		final->aggfilter = NULL;
+		final->aggstar = false;
+		final->aggvariadic = false;
+
+		return (Node *) final;
+	}
+	return expression_tree_mutator(node, make_final_agg_expr_mutator,
+								   (void *) context);
+}
+
 /*
  * make_subplanTargetList
  *	  Generate appropriate target list when grouping is required.
@@ -4058,65 +5280,113 @@ postprocess_setop_tlist(List *new_tlist, List *orig_tlist)
 static List *
 select_active_windows(PlannerInfo *root, WindowFuncLists *wflists)
 {
-	List	   *result;
-	List	   *actives;
+	List	   *windowClause = root->parse->windowClause;
+	List	   *result = NIL;
+	WindowClauseSortData *actives;
+	int			nActive = 0;
+	int			i;
 	ListCell   *lc;
 
+	if (windowClause == NIL)
+		return NIL;
+
 	/* First, make a list of the active windows */
-	actives = NIL;
-	foreach(lc, root->parse->windowClause)
+	actives = (WindowClauseSortData *)
+		palloc(sizeof(WindowClauseSortData) * list_length(windowClause));
+	foreach(lc, windowClause)
 	{
 		WindowClause *wc = (WindowClause *) lfirst(lc);
 
 		/* It's only active if wflists shows some related WindowFuncs */
 		Assert(wc->winref <= wflists->maxWinRef);
-		if (wflists->windowFuncs[wc->winref] != NIL)
-			actives = lappend(actives, wc);
+		if (wflists->windowFuncs[wc->winref] == NIL)
+			continue;
+
+		actives[nActive].wc = wc;
+
+		/*
+		 * For sorting, we want the list of partition keys followed by the
+		 * list of sort keys.  Pathkey construction removes duplicates between
+		 * the two, so do likewise here; partitionClause and orderClause had
+		 * their own duplicates removed in parse analysis, so we need only
+		 * drop orderClause entries that also appear in partitionClause.
+		 */
+		actives[nActive].uniqueOrder =
+			list_concat_unique(list_copy(wc->partitionClause),
+							   wc->orderClause);
+		nActive++;
 	}
 
 	/*
-	 * Now, ensure that windows with identical partitioning/ordering clauses
-	 * are adjacent in the list.  This is required by the SQL standard, which
+	 * Now, sort the active windows by their partitioning/ordering clauses,
+	 * ignoring framing clauses, so that windows with identical clauses are
+	 * adjacent in the list.  This is required by the SQL standard, which
 	 * says that only one sort is to be used for such windows, even if they
 	 * are otherwise distinct (eg, different names or framing clauses).
 	 *
-	 * There is room to be much smarter here, for example detecting whether
-	 * one window's sort keys are a prefix of another's (so that sorting for
-	 * the latter would do for the former), or putting windows first that
-	 * match a sort order available for the underlying query.  For the moment
-	 * we are content with meeting the spec.
+	 * Additionally, if one window's clauses are a prefix of another's, the
+	 * window with the stronger sorting requirement is put first.  Sorting for
+	 * that one then leaves the input suitably ordered for the weaker one, and
+	 * grouping_planner won't need a second Sort node.
 	 */
-	result = NIL;
-	while (actives != NIL)
-	{
-		WindowClause *wc = (WindowClause *) linitial(actives);
-		ListCell   *prev;
-		ListCell   *next;
+	qsort(actives, nActive, sizeof(WindowClauseSortData), common_prefix_cmp);
 
-		/* Move wc from actives to result */
-		actives = list_delete_first(actives);
-		result = lappend(result, wc);
+	/* Build the ordered list of the original WindowClause nodes */
+	for (i = 0; i < nActive; i++)
+		result = lappend(result, actives[i].wc);
 
-		/* Now move any matching windows from actives to result */
-		prev = NULL;
-		for (lc = list_head(actives); lc; lc = next)
-		{
-			WindowClause *wc2 = (WindowClause *) lfirst(lc);
+	pfree(actives);
 
-			next = lnext(lc);
-			/* framing options are NOT to be compared here! */
-			if (equal(wc->partitionClause, wc2->partitionClause) &&
-				equal(wc->orderClause, wc2->orderClause))
-			{
-				actives = list_delete_cell(actives, lc, prev);
-				result = lappend(result, wc2);
-			}
-			else
-				prev = lc;
-		}
+	return result;
+}
+
+/*
+ * common_prefix_cmp
+ *	  qsort comparator for WindowClauseSortData
+ *
+ * Sorts windows so that those sharing a common prefix of sort clauses are
+ * adjacent, with the longer clause list first.  Ties are broken by winref,
+ * which keeps the result independent of qsort's stability.
+ */
+static int
+common_prefix_cmp(const void *a, const void *b)
+{
+	const WindowClauseSortData *wcsa = (const WindowClauseSortData *) a;
+	const WindowClauseSortData *wcsb = (const WindowClauseSortData *) b;
+	ListCell   *item_a;
+	ListCell   *item_b;
+
+	forboth(item_a, wcsa->uniqueOrder, item_b, wcsb->uniqueOrder)
+	{
+		SortGroupClause *sca = (SortGroupClause *) lfirst(item_a);
+		SortGroupClause *scb = (SortGroupClause *) lfirst(item_b);
+
+		if (sca->tleSortGroupRef > scb->tleSortGroupRef)
+			return -1;
+		else if (sca->tleSortGroupRef < scb->tleSortGroupRef)
+			return 1;
+		else if (sca->sortop > scb->sortop)
+			return -1;
+		else if (sca->sortop < scb->sortop)
+			return 1;
+		else if (sca->nulls_first && !scb->nulls_first)
+			return -1;
+		else if (!sca->nulls_first && scb->nulls_first)
+			return 1;
+		/* no need to compare eqop, since it is fully determined by sortop */
 	}
 
-	return result;
+	if (list_length(wcsa->uniqueOrder) > list_length(wcsb->uniqueOrder))
+		return -1;
+	else if (list_length(wcsa->uniqueOrder) < list_length(wcsb->uniqueOrder))
+		return 1;
+
+	if (wcsa->wc->winref < wcsb->wc->winref)
+		return -1;
+	else if (wcsa->wc->winref > wcsb->wc->winref)
+		return 1;
+
+	return 0;
 }
 
 /*
@@ -4540,7 +5810,7 @@ plan_cluster_use_sort(Oid tableOid, Oid indexOid)
 	comparisonCost = 2.0 * (indexExprCost.startup + indexExprCost.per_tuple);
 
 	/* Estimate the cost of seq scan + sort */
-	seqScanPath = create_seqscan_path(root, rel, NULL);
+	seqScanPath = create_seqscan_path(root, rel, NULL, 0);
 	cost_sort(&seqScanAndSortPath, root, NIL,
 			  seqScanPath->total_cost, rel->tuples, rel->width,
 			  comparisonCost, maintenance_work_mem, -1.0);
@@ -4549,7 +5819,7 @@ plan_cluster_use_sort(Oid tableOid, Oid indexOid)
 	indexScanPath = create_index_path(root, indexInfo,
 									  NIL, NIL, NIL, NIL, NIL,
 									  ForwardScanDirection, false,
-									  NULL, 1.0);
+									  NULL, 1.0, 0);
 
 	return (seqScanAndSortPath.total_cost < indexScanPath->path.total_cost);
 }
@@ -434,6 +434,9 @@ set_plan_refs(PlannerInfo *root, Plan *plan, int rtoffset)
 	if (plan == NULL)
 		return NULL;
 
+	/* Assign this node a unique ID. */
+	plan->plan_node_id = root->glob->lastPlanNodeId++;
+
 	/*
 	 * Plan-type-specific fixes
 	 */
@@ -596,8 +599,10 @@ set_plan_refs(PlannerInfo *root, Plan *plan, int rtoffset)
 		case T_Hash:
 		case T_Material:
 		case T_Sort:
+		case T_IncrementalSort:
 		case T_Unique:
 		case T_SetOp:
+		case T_Gather:
 
 			/*
 			 * These plan types don't actually bother to evaluate their
@@ -614,6 +619,17 @@ set_plan_refs(PlannerInfo *root, Plan *plan, int rtoffset)
 			 */
 			Assert(plan->qual == NIL);
 			break;
+		case T_Memoize:
+			{
+				Memoize    *mplan = (Memoize *) plan;
+
+				/* like the above, but there are cache keys to fix too */
+				set_dummy_tlist_references(plan, rtoffset);
+				Assert(plan->qual == NIL);
+				mplan->param_exprs = fix_scan_list(root, mplan->param_exprs,
+												   rtoffset);
+			}
+			break;
 		case T_LockRows:
 			{
 				LockRows   *splan = (LockRows *) plan;
@@ -823,6 +839,10 @@ set_plan_refs(PlannerInfo *root, Plan *plan, int rtoffset)
 				 */
 				set_dummy_tlist_references(plan, rtoffset);
 				Assert(splan->plan.qual == NIL);
+				splan->prunequals =
+					fix_scan_list(root, splan->prunequals, rtoffset);
+				splan->pruneconstrs =
+					fix_scan_list(root, splan->pruneconstrs, rtoffset);
 				foreach(l, splan->appendplans)
 				{
 					lfirst(l) = set_plan_refs(root,
@@ -841,6 +861,10 @@ set_plan_refs(PlannerInfo *root, Plan *plan, int rtoffset)
 				 */
 				set_dummy_tlist_references(plan, rtoffset);
 				Assert(splan->plan.qual == NIL);
+				splan->prunequals =
+					fix_scan_list(root, splan->prunequals, rtoffset);
+				splan->pruneconstrs =
+					fix_scan_list(root, splan->pruneconstrs, rtoffset);
 				foreach(l, splan->mergeplans)
 				{
 					lfirst(l) = set_plan_refs(root,
@@ -14,6 +14,8 @@
 #include "postgres.h"
 
 #include "access/htup_details.h"
+#include "catalog/pg_attribute.h"
+#include "catalog/pg_class.h"
 #include "catalog/pg_operator.h"
 #include "catalog/pg_type.h"
 #include "executor/executor.h"
@@ -28,6 +30,7 @@
 #include "optimizer/subselect.h"
 #include "optimizer/var.h"
 #include "parser/parse_relation.h"
+#include "parser/parsetree.h"
 #include "rewrite/rewriteManip.h"
 #include "utils/builtins.h"
 #include "utils/lsyscache.h"
@@ -52,6 +55,13 @@ typedef struct finalize_primnode_context
 	Bitmapset  *paramids;		/* Non-local PARAM_EXEC paramids found */
 } finalize_primnode_context;
 
+typedef struct inline_cte_walker_context
+{
+	const char *ctename;		/* name and relative level of target CTE */
+	int			levelsup;
+	Query	   *ctequery;		/* query to substitute */
+} inline_cte_walker_context;
+
 
 static Node *build_subplan(PlannerInfo *root, Plan *plan, PlannerInfo *subroot,
 			  List *plan_params,
@@ -67,9 +77,17 @@ static Node *convert_testexpr(PlannerInfo *root,
 				 List *subst_nodes);
 static Node *convert_testexpr_mutator(Node *node,
 						 convert_testexpr_context *context);
+static bool contain_dml(Node *node);
+static bool contain_dml_walker(Node *node, void *context);
+static bool contain_outer_selfref(Node *node);
+static bool contain_outer_selfref_walker(Node *node, Index *depth);
+static void inline_cte(PlannerInfo *root, CommonTableExpr *cte);
+static bool inline_cte_walker(Node *node, inline_cte_walker_context *context);
 static bool subplan_is_hashable(Plan *plan);
 static bool testexpr_is_hashable(Node *testexpr);
 static bool hash_ok_operator(OpExpr *expr);
+static Relids get_nullable_relids_in_jointree(Node *jtnode);
+static bool var_is_nonnullable(Query *query, Var *var, Relids nullable_rels);
 static bool simplify_EXISTS_query(PlannerInfo *root, Query *query);
 static Query *convert_EXISTS_to_ANY(PlannerInfo *root, Query *subselect,
 					  Node **testexpr, List **paramIds);
@@ -1147,6 +1165,50 @@ SS_process_ctes(PlannerInfo *root)
 			continue;
 		}
 
+		/*
+		 * Consider inlining the CTE (creating RTE_SUBQUERY RTE(s)) instead of
+		 * implementing it as a separately-planned CTE.
+		 *
+		 * We cannot inline if any of these conditions hold:
+		 *
+		 * 1. The user said not to (the CTEMaterializeAlways option).
+		 *
+		 * 2. The CTE is recursive.
+		 *
+		 * 3. The CTE has side-effects; this includes either not being a plain
+		 * SELECT, or containing volatile functions.  Inlining might change
+		 * the side-effects, which would be bad.
+		 *
+		 * 4. The CTE is multiply-referenced and contains a self-reference to
+		 * a recursive CTE outside itself.  Inlining would result in multiple
+		 * recursive self-references, which we don't support.
+		 *
+		 * Otherwise, we have an option whether to inline or not.  That should
+		 * always be a win if there's just a single reference, but if the CTE
+		 * is multiply-referenced then it's unclear: inlining adds duplicate
+		 * computations, but the ability to absorb restrictions from the outer
+		 * query level could outweigh that.  We do not have nearly enough
+		 * information at this point to tell whether that's true, so we let
+		 * the user express a preference.  Our default behavior is to inline
+		 * only singly-referenced CTEs, but a CTE marked CTEMaterializeNever
+		 * will be inlined even if multiply referenced.
+		 */
+		if ((cte->ctematerialized == CTEMaterializeNever ||
+			 (cte->ctematerialized == CTEMaterializeDefault &&
+			  cte->cterefcount == 1)) &&
+			!cte->cterecursive &&
+			cmdType == CMD_SELECT &&
+			!contain_dml(cte->ctequery) &&
+			(cte->cterefcount <= 1 ||
+			 !contain_outer_selfref(cte->ctequery)) &&
+			!contain_volatile_functions(cte->ctequery))
+		{
+			inline_cte(root, cte);
+			/* Make a dummy entry in cte_plan_ids */
+			root->cte_plan_ids = lappend_int(root->cte_plan_ids, -1);
+			continue;
+		}
+
 		/*
 		 * Copy the source Query node.  Probably not necessary, but let's keep
 		 * this similar to make_subplan.
@@ -1228,6 +1290,175 @@ SS_process_ctes(PlannerInfo *root)
 	}
 }
 
+/*
+ * contain_dml: is any subquery not a plain SELECT?
+ *
+ * We reject SELECT FOR UPDATE/SHARE as well as INSERT etc.
+ */
+static bool
+contain_dml(Node *node)
+{
+	return contain_dml_walker(node, NULL);
+}
+
+static bool
+contain_dml_walker(Node *node, void *context)
+{
+	if (node == NULL)
+		return false;
+	if (IsA(node, Query))
+	{
+		Query	   *query = (Query *) node;
+
+		if (query->commandType != CMD_SELECT ||
+			query->rowMarks != NIL)
+			return true;
+
+		return query_tree_walker(query, contain_dml_walker, context, 0);
+	}
+	return expression_tree_walker(node, contain_dml_walker, context);
+}
+
+/*
+ * contain_outer_selfref: is there an external recursive self-reference?
+ */
+static bool
+contain_outer_selfref(Node *node)
+{
+	Index		depth = 0;
+
+	/*
+	 * We should be starting with a Query, so that depth will be 1 while
+	 * examining its immediate contents.
+	 */
+	Assert(IsA(node, Query));
+
+	return contain_outer_selfref_walker(node, &depth);
+}
+
+static bool
+contain_outer_selfref_walker(Node *node, Index *depth)
+{
+	if (node == NULL)
+		return false;
+	if (IsA(node, RangeTblEntry))
+	{
+		RangeTblEntry *rte = (RangeTblEntry *) node;
+
+		/*
+		 * Check for a self-reference to a CTE that's above the Query that our
+		 * search started at.
+		 */
+		if (rte->rtekind == RTE_CTE &&
+			rte->self_reference &&
+			rte->ctelevelsup >= *depth)
+			return true;
+		return false;			/* allow range_table_walker to continue */
+	}
+	if (IsA(node, Query))
+	{
+		/* Recurse into subquery, tracking nesting depth properly */
+		Query	   *query = (Query *) node;
+		bool		result;
+
+		(*depth)++;
+
+		result = query_tree_walker(query, contain_outer_selfref_walker,
+								   (void *) depth, QTW_EXAMINE_RTES);
+
+		(*depth)--;
+
+		return result;
+	}
+	return expression_tree_walker(node, contain_outer_selfref_walker,
+								  (void *) depth);
+}
+
+/*
+ * inline_cte: convert RTE_CTE references to given CTE into RTE_SUBQUERYs
+ */
+static void
+inline_cte(PlannerInfo *root, CommonTableExpr *cte)
+{
+	inline_cte_walker_context context;
+
+	context.ctename = cte->ctename;
+	/* Start at levelsup = -1 because we'll immediately increment it */
+	context.levelsup = -1;
+	context.ctequery = (Query *) cte->ctequery;
+	Assert(IsA(context.ctequery, Query));
+
+	(void) inline_cte_walker((Node *) root->parse, &context);
+}
+
+static bool
+inline_cte_walker(Node *node, inline_cte_walker_context *context)
+{
+	if (node == NULL)
+		return false;
+	if (IsA(node, Query))
+	{
+		Query	   *query = (Query *) node;
+
+		context->levelsup++;
+
+		/*
+		 * Visit the query's RTE nodes after their contents; otherwise
+		 * query_tree_walker would descend into the newly inlined CTE query,
+		 * which we don't want.
+		 */
+		(void) query_tree_walker(query, inline_cte_walker, context,
+								 QTW_EXAMINE_RTES_AFTER);
+
+		context->levelsup--;
+
+		return false;
+	}
+	else if (IsA(node, RangeTblEntry))
+	{
+		RangeTblEntry *rte = (RangeTblEntry *) node;
+
+		if (rte->rtekind == RTE_CTE &&
+			strcmp(rte->ctename, context->ctename) == 0 &&
+			rte->ctelevelsup == context->levelsup)
+		{
+			/*
+			 * Found a reference to replace.  Generate a copy of the CTE query
+			 * with appropriate level adjustment for outer references (e.g.,
+			 * to other CTEs).
+			 */
+			Query	   *newquery = copyObject(context->ctequery);
+
+			if (context->levelsup > 0)
+				IncrementVarSublevelsUp((Node *) newquery, context->levelsup, 1);
+
+			/*
+			 * Convert the RTE_CTE RTE into a RTE_SUBQUERY.
+			 *
+			 * Historically, a FOR UPDATE clause has been treated as extending
+			 * into views and subqueries, but not into CTEs.  We preserve this
+			 * distinction by not trying to push rowmarks into the new
+			 * subquery.
+			 */
+			rte->rtekind = RTE_SUBQUERY;
+			rte->subquery = newquery;
+			rte->security_barrier = false;
+
+			/* Zero out CTE-specific fields */
+			rte->ctename = NULL;
+			rte->ctelevelsup = 0;
+			rte->self_reference = false;
+			rte->ctecoltypes = NIL;
+			rte->ctecoltypmods = NIL;
+			rte->ctecolcollations = NIL;
+		}
+
+		return false;
+	}
+
+	return expression_tree_walker(node, inline_cte_walker, context);
+}
+
 /*
  * convert_ANY_sublink_to_join: try to convert an ANY SubLink to a join
  *
@@ -1360,6 +1591,196 @@ convert_ANY_sublink_to_join(PlannerInfo *root, SubLink *sublink,
 	return result;
 }
 
+/*
+ * convert_NOT_IN_sublink_to_join: try to convert NOT of an ANY SubLink to
+ * an anti-join
+ *
+ * Unlike NOT EXISTS, NOT IN yields NULL rather than TRUE when the comparison
+ * yields NULL for some row of the sub-select and TRUE for none, which an
+ * anti-join can't reproduce.  So we only convert when the comparisons
+ * provably never yield NULL: each must be a strict, mergejoinable operator
+ * comparing a column of the parent query to an output column of the
+ * sub-select, where both columns are declared NOT NULL and are not on the
+ * nullable side of any outer join.  The result is then built just as by
+ * convert_ANY_sublink_to_join, except for the join type.
+ *
+ * jtnode is the jointree node the new join will be stacked onto; outer
+ * joins within it determine which of the parent's columns may go to NULL.
+ */
+JoinExpr *
+convert_NOT_IN_sublink_to_join(PlannerInfo *root, SubLink *sublink,
+							   Relids available_rels, Node *jtnode)
+{
+	Query	   *subselect = (Query *) sublink->subselect;
+	Relids		outer_nullable_rels;
+	Relids		inner_nullable_rels;
+	List	   *opexprs;
+	ListCell   *lc;
+	JoinExpr   *result;
+
+	Assert(sublink->subLinkType == ANY_SUBLINK);
+
+	/* Grouping sets could add NULLs to the sub-select's output columns */
+	if (subselect->groupingSets != NIL)
+		return NULL;
+
+	if (and_clause(sublink->testexpr))
+		opexprs = ((BoolExpr *) sublink->testexpr)->args;
+	else
+		opexprs = list_make1(sublink->testexpr);
+
+	outer_nullable_rels = get_nullable_relids_in_jointree(jtnode);
+	inner_nullable_rels =
+		get_nullable_relids_in_jointree((Node *) subselect->jointree);
+
+	foreach(lc, opexprs)
+	{
+		OpExpr	   *opexpr = (OpExpr *) lfirst(lc);
+		Node	   *leftop;
+		Node	   *rightop;
+		Param	   *param;
+		TargetEntry *tle;
+
+		if (!IsA(opexpr, OpExpr) ||
+			list_length(opexpr->args) != 2)
+			return NULL;
+
+		/*
+		 * A strict mergejoinable operator is an equality that yields NULL
+		 * only for NULL inputs.
+		 */
+		if (!op_strict(opexpr->opno) ||
+			get_mergejoin_opfamilies(opexpr->opno) == NIL)
+			return NULL;
+
+		leftop = (Node *) linitial(opexpr->args);
+		while (leftop && IsA(leftop, RelabelType))
+			leftop = (Node *) ((RelabelType *) leftop)->arg;
+		rightop = (Node *) lsecond(opexpr->args);
+		while (rightop && IsA(rightop, RelabelType))
+			rightop = (Node *) ((RelabelType *) rightop)->arg;
+
+		/* The left-hand input must be a non-nullable column of the parent */
+		if (!leftop || !IsA(leftop, Var) ||
+			!var_is_nonnullable(root->parse, (Var *) leftop,
+								outer_nullable_rels))
+			return NULL;
+
+		/* The right-hand input must stand for a non-nullable output column */
+		if (!rightop || !IsA(rightop, Param))
+			return NULL;
+		param = (Param *) rightop;
+		if (param->paramkind != PARAM_SUBLINK)
+			return NULL;
+		tle = get_tle_by_resno(subselect->targetList, param->paramid);
+		if (tle == NULL || !IsA(tle->expr, Var) ||
+			!var_is_nonnullable(subselect, (Var *) tle->expr,
+								inner_nullable_rels))
+			return NULL;
+	}
+
+	result = convert_ANY_sublink_to_join(root, sublink, available_rels);
+	if (result != NULL)
+		result->jointype = JOIN_ANTI;
+
+	return result;
+}
+
+/*
+ * get_nullable_relids_in_jointree: get the set of base relations that lie
+ * on the nullable side of some outer join within the given jointree node
+ */
+static Relids
+get_nullable_relids_in_jointree(Node *jtnode)
+{
+	Relids		result = NULL;
+
+	if (jtnode == NULL)
+		return NULL;
+	if (IsA(jtnode, RangeTblRef))
+	{
+		/* nothing to do */
+	}
+	else if (IsA(jtnode, FromExpr))
+	{
+		FromExpr   *f = (FromExpr *) jtnode;
+		ListCell   *l;
+
+		foreach(l, f->fromlist)
+			result = bms_join(result,
+							  get_nullable_relids_in_jointree(lfirst(l)));
+	}
+	else if (IsA(jtnode, JoinExpr))
+	{
+		JoinExpr   *j = (JoinExpr *) jtnode;
+
+		result = bms_join(get_nullable_relids_in_jointree(j->larg),
+						  get_nullable_relids_in_jointree(j->rarg));
+		switch (j->jointype)
+		{
+			case JOIN_INNER:
+			case JOIN_SEMI:
+				break;
+			case JOIN_LEFT:
+			case JOIN_ANTI:
+				result = bms_join(result,
+								  get_relids_in_jointree(j->rarg, false));
+				break;
+			case JOIN_FULL:
+				result = bms_join(result,
+								  get_relids_in_jointree(j->larg, false));
+				result = bms_join(result,
+								  get_relids_in_jointree(j->rarg, false));
+				break;
+			case JOIN_RIGHT:
+				result = bms_join(result,
+								  get_relids_in_jointree(j->larg, false));
+				break;
+			default:
+				elog(ERROR, "unrecognized join type: %d",
+					 (int) j->jointype);
+				break;
+		}
+	}
+	else
+		elog(ERROR, "unrecognized node type: %d",
+			 (int) nodeTag(jtnode));
+	return result;
+}
+
+/*
+ * var_is_nonnullable: is the Var, belonging to the given query, a column
+ * declared NOT NULL of a plain table, and not nulled by an outer join?
+ */
+static bool
+var_is_nonnullable(Query *query, Var *var, Relids nullable_rels)
+{
+	RangeTblEntry *rte;
+	HeapTuple	tp;
+	bool		result;
+
+	if (var->varlevelsup != 0 ||
+		var->varattno <= 0 ||
+		bms_is_member(var->varno, nullable_rels))
+		return false;
+
+	/* Constraints on foreign tables aren't enforced locally */
+	rte = rt_fetch(var->varno, query->rtable);
+	if (rte->rtekind != RTE_RELATION ||
+		rte->relkind == RELKIND_FOREIGN_TABLE)
+		return false;
+
+	tp = SearchSysCache2(ATTNUM,
+						 ObjectIdGetDatum(rte->relid),
+						 Int16GetDatum(var->varattno));
+	if (!HeapTupleIsValid(tp))
+		return false;
+	result = ((Form_pg_attribute) GETSTRUCT(tp))->attnotnull;
+	ReleaseSysCache(tp);
+
+	return result;
+}
+
 /*
  * convert_EXISTS_sublink_to_join: try to convert an EXISTS SubLink to a join
  *
@@ -2534,10 +2955,16 @@ finalize_plan(PlannerInfo *root, Plan *plan, Bitmapset *valid_params,
 							  &context);
 			break;
 
+		case T_Memoize:
+			finalize_primnode((Node *) ((Memoize *) plan)->param_exprs,
+							  &context);
+			break;
+
 		case T_Hash:
 		case T_Agg:
 		case T_Material:
 		case T_Sort:
+		case T_IncrementalSort:
 		case T_Unique:
 		case T_SetOp:
 		case T_Group:
@@ -99,6 +99,7 @@ static List *generate_append_tlist(List *colTypes, List *colCollations,
 					  List *input_plans,
 					  List *refnames_tlist);
 static List *generate_setop_grouplist(SetOperationStmt *op, List *targetlist);
+static List *generate_cycle_grouplist(SetOperationStmt *op, List *targetlist);
 static void expand_inherited_rtentry(PlannerInfo *root, RangeTblEntry *rte,
 						 Index rti);
 static void make_inh_translation_list(Relation oldrelation,
@@ -400,9 +401,10 @@ generate_recursion_plan(SetOperationStmt *setOp, PlannerInfo *root,
 								  refnames_tlist);
 
 	/*
-	 * If UNION, identify the grouping operators
+	 * If UNION, or if there is a CYCLE clause, identify the grouping
+	 * operators
 	 */
-	if (setOp->all)
+	if (setOp->all && setOp->cycleColIdx == NIL)
 	{
 		groupList = NIL;
 		numGroups = 0;
@@ -411,8 +413,14 @@ generate_recursion_plan(SetOperationStmt *setOp, PlannerInfo *root,
 	{
 		double		dNumGroups;
 
-		/* Identify the grouping semantics */
-		groupList = generate_setop_grouplist(setOp, tlist);
+		/*
+		 * Identify the grouping semantics.  With CYCLE, only the listed
+		 * columns are compared, which also covers plain UNION's duplicates.
+		 */
+		if (setOp->cycleColIdx != NIL)
+			groupList = generate_cycle_grouplist(setOp, tlist);
+		else
+			groupList = generate_setop_grouplist(setOp, tlist);
 
 		/* We only support hashing here */
 		if (!grouping_is_hashable(groupList))
@@ -775,6 +783,8 @@ make_union_unique(SetOperationStmt *op, Plan *plan,
 								 extract_grouping_ops(groupList),
 								 NIL,
 								 numGroups,
+								 false,
+								 true,
 								 plan);
 		/* Hashed aggregation produces randomly-ordered results */
 		*sortClauses = NIL;
@@ -1183,6 +1193,32 @@ generate_setop_grouplist(SetOperationStmt *op, List *targetlist)
 	return grouplist;
 }
 
+/*
+ * generate_cycle_grouplist
+ *		Build a SortGroupClause list for the CYCLE columns of a recursive
+ *		union, in the same way as generate_setop_grouplist.
+ */
+static List *
+generate_cycle_grouplist(SetOperationStmt *op, List *targetlist)
+{
+	List	   *grouplist = (List *) copyObject(op->cycleClauses);
+	ListCell   *lg;
+	ListCell   *lc;
+	Index		refno = 1;
+
+	forboth(lg, grouplist, lc, op->cycleColIdx)
+	{
+		SortGroupClause *sgc = (SortGroupClause *) lfirst(lg);
+		TargetEntry *tle = (TargetEntry *) list_nth(targetlist,
+													lfirst_int(lc) - 1);
+
+		Assert(!tle->resjunk && tle->resno == lfirst_int(lc));
+		Assert(tle->ressortgroupref == 0);
+		sgc->tleSortGroupRef = tle->ressortgroupref = refno++;
+	}
+	return grouplist;
+}
+
 
 /*
  * expand_inherited_tables
@@ -65,6 +65,7 @@ typedef struct
 	List	   *active_fns;
 	Node	   *case_val;
 	bool		estimate;
+	bool		bind_params;
 } eval_const_expressions_context;
 
 typedef struct
@@ -96,6 +97,7 @@ static bool contain_subplans_walker(Node *node, void *context);
 static bool contain_mutable_functions_walker(Node *node, void *context);
 static bool contain_volatile_functions_walker(Node *node, void *context);
 static bool contain_volatile_functions_not_nextval_walker(Node *node, void *context);
+static bool has_parallel_hazard_walker(Node *node, void *context);
 static bool contain_nonstrict_functions_walker(Node *node, void *context);
 static bool contain_leaked_vars_walker(Node *node, void *context);
 static Relids find_nonnullable_rels_walker(Node *node, bool top_level);
@@ -1193,6 +1195,54 @@ contain_volatile_functions_not_nextval_walker(Node *node, void *context)
 								  context);
 }
 
+/*****************************************************************************
+ *		Check clauses for parallel hazards
+ *****************************************************************************/
+
+/*
+ * has_parallel_hazard
+ *	  Recursively search an expression for constructs that can't be
+ *	  evaluated safely in parallel mode.
+ *
+ * If allow_restricted is true, the expression will be evaluated by the
+ * parallel group leader, so we only need to exclude operations that are
+ * prohibited in parallel mode altogether; we conservatively assume that any
+ * volatile function might write to the database or otherwise change state.
+ *
+ * If allow_restricted is false, the expression will be evaluated in
+ * parallel workers, and we must also exclude things the workers can't get
+ * right on their own.  Workers don't share the leader's idea of the
+ * statement timestamp, so stable functions such as now() must be excluded
+ * along with volatile ones.  Sub-selects and parameters are excluded
+ * because we don't pass their values down to the workers.
+ */
+bool
+has_parallel_hazard(Node *node, bool allow_restricted)
+{
+	if (allow_restricted)
+		return contain_volatile_functions(node);
+
+	if (contain_mutable_functions(node))
+		return true;
+
+	return has_parallel_hazard_walker(node, NULL);
+}
+
+static bool
+has_parallel_hazard_walker(Node *node, void *context)
+{
+	if (node == NULL)
+		return false;
+	if (IsA(node, SubLink) ||
+		IsA(node, SubPlan) ||
+		IsA(node, AlternativeSubPlan) ||
+		IsA(node, Param) ||
+		IsA(node, PlaceHolderVar))
+		return true;
+	return expression_tree_walker(node, has_parallel_hazard_walker,
+								  context);
+}
+
 /*****************************************************************************
  *		Check clauses for nonstrict functions
  *****************************************************************************/
@@ -2344,6 +2394,31 @@ eval_const_expressions(PlannerInfo *root, Node *node)
 	context.active_fns = NIL;	/* nothing being recursively simplified */
 	context.case_val = NULL;	/* no CASE being examined */
 	context.estimate = false;	/* safe transformations only */
+	context.bind_params = false;	/* only PARAM_FLAG_CONST Params */
+	return eval_const_expressions_mutator(node, &context);
+}
+
+/*--------------------
+ * eval_const_expressions_params
+ *
+ * Like eval_const_expressions(), but substitute the values of all the
+ * external Params that have a value in boundParams, whether or not they are
+ * marked PARAM_FLAG_CONST.  The result is therefore only valid for one
+ * execution of a plan with those Param values; the executor uses this to
+ * simplify expressions kept in the plan when it starts up.
+ *--------------------
+ */
+Node *
+eval_const_expressions_params(ParamListInfo boundParams, Node *node)
+{
+	eval_const_expressions_context context;
+
+	context.boundParams = boundParams;	/* bound Params */
+	context.root = NULL;
+	context.active_fns = NIL;	/* nothing being recursively simplified */
+	context.case_val = NULL;	/* no CASE being examined */
+	context.estimate = false;	/* safe transformations only */
+	context.bind_params = true; /* but substitute all Params */
 	return eval_const_expressions_mutator(node, &context);
 }
 
@@ -2375,6 +2450,7 @@ estimate_expression_value(PlannerInfo *root, Node *node)
 	context.active_fns = NIL;	/* nothing being recursively simplified */
 	context.case_val = NULL;	/* no CASE being examined */
 	context.estimate = true;	/* unsafe transformations OK */
+	context.bind_params = false;
 	return eval_const_expressions_mutator(node, &context);
 }
 
@@ -2398,10 +2474,16 @@ eval_const_expressions_mutator(Node *node,
 				{
 					ParamExternData *prm = &context->boundParams->params[param->paramid - 1];
 
+					/* give hook a chance in case parameter is dynamic */
+					if (context->bind_params && !OidIsValid(prm->ptype) &&
+						context->boundParams->paramFetch != NULL)
+						(*context->boundParams->paramFetch) (context->boundParams,
+															 param->paramid);
+
 					if (OidIsValid(prm->ptype))
 					{
 						/* OK to substitute parameter value? */
-						if (context->estimate ||
+						if (context->estimate || context->bind_params ||
 							(prm->pflags & PARAM_FLAG_CONST))
 						{
 							/*
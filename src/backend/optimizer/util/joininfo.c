@@ -36,45 +36,48 @@ bool
 have_relevant_joinclause(PlannerInfo *root,
 						 RelOptInfo *rel1, RelOptInfo *rel2)
 {
-	bool		result = false;
-	List	   *joininfo;
-	Relids		other_relids;
-	ListCell   *l;
-
 	/*
-	 * We could scan either relation's joininfo list; may as well use the
-	 * shorter one.
+	 * A joinclause involves both rels just when its required_relids overlap
+	 * both, so it's enough to check rel2 against the union of the
+	 * required_relids of rel1's joinclauses.  The same goes for the
+	 * EquivalenceClasses mentioning rel1, which might contain relationships
+	 * not emitted into the joininfo lists.  join_partner_relids holds both
+	 * unions, less rel1's own relids, which is fine since the two rels never
+	 * overlap here.  Join search asks this question for a great many pairs
+	 * of rels, so this is much cheaper than scanning the joininfo lists and
+	 * EquivalenceClasses each time.
 	 */
-	if (list_length(rel1->joininfo) <= list_length(rel2->joininfo))
-	{
-		joininfo = rel1->joininfo;
-		other_relids = rel2->relids;
-	}
-	else
-	{
-		joininfo = rel2->joininfo;
-		other_relids = rel1->relids;
-	}
+	Assert(!bms_overlap(rel1->relids, rel2->relids));
+
+	return bms_overlap(rel1->join_partner_relids, rel2->relids);
+}
 
-	foreach(l, joininfo)
+/*
+ * set_base_rel_join_partners
+ *		Compute join_partner_relids for a base relation.
+ *
+ * This must be done once the rel's joininfo list and the EquivalenceClasses
+ * are final, and before join search.  Join relations get theirs from their
+ * input rels in build_join_rel().
+ */
+void
+set_base_rel_join_partners(PlannerInfo *root, RelOptInfo *rel)
+{
+	Relids		partners = NULL;
+	ListCell   *l;
+
+	foreach(l, rel->joininfo)
 	{
 		RestrictInfo *rinfo = (RestrictInfo *) lfirst(l);
 
-		if (bms_overlap(other_relids, rinfo->required_relids))
-		{
-			result = true;
-			break;
-		}
+		partners = bms_add_members(partners, rinfo->required_relids);
 	}
 
-	/*
-	 * We also need to check the EquivalenceClass data structure, which might
-	 * contain relationships not emitted into the joininfo lists.
-	 */
-	if (!result && rel1->has_eclass_joins && rel2->has_eclass_joins)
-		result = have_relevant_eclass_joinclause(root, rel1, rel2);
+	if (rel->has_eclass_joins)
+		partners = bms_add_members(partners,
+								   get_eclass_join_partners(root, rel));
 
-	return result;
+	rel->join_partner_relids = bms_del_members(partners, rel->relids);
 }
 
 
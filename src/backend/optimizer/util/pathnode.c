@@ -685,6 +685,47 @@ add_path_precheck(RelOptInfo *parent_rel,
 	return true;
 }
 
+/*
+ * add_partial_path
+ *	  Consider a partial path for a relation, that is, one that produces only
+ *	  a share of the relation's rows when run in each of several processes,
+ *	  to be combined by a Gather node above it.
+ *
+ *	  Partial paths are only useful as input to Gather or to other partial
+ *	  paths, neither of which cares about ordering or startup cost, and none
+ *	  of them is parameterized.  So for now we just keep the one with the
+ *	  cheapest total cost in the rel's partial_pathlist.
+ */
+void
+add_partial_path(RelOptInfo *parent_rel, Path *new_path)
+{
+	Path	   *old_path;
+
+	/* Check for query cancel. */
+	CHECK_FOR_INTERRUPTS();
+
+	Assert(new_path->parallel_degree > 0);
+	Assert(new_path->param_info == NULL);
+
+	if (parent_rel->partial_pathlist != NIL)
+	{
+		old_path = (Path *) linitial(parent_rel->partial_pathlist);
+		if (old_path->total_cost <= new_path->total_cost)
+		{
+			/* Reject and recycle the new path */
+			if (!IsA(new_path, IndexPath))
+				pfree(new_path);
+			return;
+		}
+	}
+
+	/*
+	 * The old path may already be referenced by a Gather path, so it can't
+	 * be freed.
+	 */
+	parent_rel->partial_pathlist = list_make1(new_path);
+}
+
 
 /*****************************************************************************
  *		PATH NODE CREATION ROUTINES
@@ -696,7 +737,8 @@ add_path_precheck(RelOptInfo *parent_rel,
  *	  pathnode.
  */
 Path *
-create_seqscan_path(PlannerInfo *root, RelOptInfo *rel, Relids required_outer)
+create_seqscan_path(PlannerInfo *root, RelOptInfo *rel,
+					Relids required_outer, int nworkers)
 {
 	Path	   *pathnode = makeNode(Path);
 
@@ -704,6 +746,8 @@ create_seqscan_path(PlannerInfo *root, RelOptInfo *rel, Relids required_outer)
 	pathnode->parent = rel;
 	pathnode->param_info = get_baserel_parampathinfo(root, rel,
 													 required_outer);
+	pathnode->parallel_aware = nworkers > 0 ? true : false;
+	pathnode->parallel_degree = nworkers;
 	pathnode->pathkeys = NIL;	/* seqscan has unordered result */
 
 	cost_seqscan(pathnode, root, rel, pathnode->param_info);
@@ -752,6 +796,7 @@ create_samplescan_path(PlannerInfo *root, RelOptInfo *rel, Relids required_outer
  * 'required_outer' is the set of outer relids for a parameterized path.
  * 'loop_count' is the number of repetitions of the indexscan to factor into
  *		estimates of caching behavior.
+ * 'parallel_degree' is the number of workers for a parallel scan, or 0.
  *
  * Returns the new path node.
  */
@@ -766,7 +811,8 @@ create_index_path(PlannerInfo *root,
 				  ScanDirection indexscandir,
 				  bool indexonly,
 				  Relids required_outer,
-				  double loop_count)
+				  double loop_count,
+				  int parallel_degree)
 {
 	IndexPath  *pathnode = makeNode(IndexPath);
 	RelOptInfo *rel = index->rel;
@@ -777,6 +823,8 @@ create_index_path(PlannerInfo *root,
 	pathnode->path.parent = rel;
 	pathnode->path.param_info = get_baserel_parampathinfo(root, rel,
 														  required_outer);
+	pathnode->path.parallel_aware = parallel_degree > 0 ? true : false;
+	pathnode->path.parallel_degree = parallel_degree;
 	pathnode->path.pathkeys = pathkeys;
 
 	/* Convert clauses to indexquals the executor can handle */
@@ -805,6 +853,7 @@ create_index_path(PlannerInfo *root,
  * 'required_outer' is the set of outer relids for a parameterized path.
  * 'loop_count' is the number of repetitions of the indexscan to factor into
  *		estimates of caching behavior.
+ * 'parallel_degree' is the number of workers for a parallel scan, or 0.
  *
  * loop_count should match the value used when creating the component
  * IndexPaths.
@@ -814,7 +863,8 @@ create_bitmap_heap_path(PlannerInfo *root,
 						RelOptInfo *rel,
 						Path *bitmapqual,
 						Relids required_outer,
-						double loop_count)
+						double loop_count,
+						int parallel_degree)
 {
 	BitmapHeapPath *pathnode = makeNode(BitmapHeapPath);
 
@@ -822,6 +872,8 @@ create_bitmap_heap_path(PlannerInfo *root,
 	pathnode->path.parent = rel;
 	pathnode->path.param_info = get_baserel_parampathinfo(root, rel,
 														  required_outer);
+	pathnode->path.parallel_aware = parallel_degree > 0 ? true : false;
+	pathnode->path.parallel_degree = parallel_degree;
 	pathnode->path.pathkeys = NIL;		/* always unordered */
 
 	pathnode->bitmapqual = bitmapqual;
@@ -1095,6 +1147,36 @@ create_material_path(RelOptInfo *rel, Path *subpath)
 	return pathnode;
 }
 
+/*
+ * create_memoize_path
+ *	  Creates a path corresponding to a Memoize plan caching the output of
+ *	  'subpath' per distinct value of 'param_exprs', returning the pathnode.
+ *	  'calls' is the number of times we expect it to be scanned.
+ */
+MemoizePath *
+create_memoize_path(RelOptInfo *rel, Path *subpath, List *param_exprs,
+					List *hash_operators, bool singlerow, double calls)
+{
+	MemoizePath *pathnode = makeNode(MemoizePath);
+
+	Assert(subpath->parent == rel);
+
+	pathnode->path.pathtype = T_Memoize;
+	pathnode->path.parent = rel;
+	pathnode->path.param_info = subpath->param_info;
+	pathnode->path.pathkeys = subpath->pathkeys;
+
+	pathnode->subpath = subpath;
+	pathnode->param_exprs = param_exprs;
+	pathnode->hash_operators = hash_operators;
+	pathnode->singlerow = singlerow;
+	pathnode->calls = calls;
+
+	cost_memoize(pathnode);
+
+	return pathnode;
+}
+
 /*
  * create_unique_path
  *	  Creates a path representing elimination of distinct rows from the
@@ -1307,6 +1389,34 @@ create_unique_path(PlannerInfo *root, RelOptInfo *rel, Path *subpath,
 	return pathnode;
 }
 
+/*
+ * create_gather_path
+ *	  Creates a path corresponding to a gather scan, returning the
+ *	  pathnode.
+ *
+ * The subpath must be a partial path, that is, one that produces only a
+ * share of the relation's rows when run in each of several processes.
+ */
+GatherPath *
+create_gather_path(PlannerInfo *root, RelOptInfo *rel, Path *subpath,
+				   Relids required_outer, int nworkers)
+{
+	GatherPath *pathnode = makeNode(GatherPath);
+
+	pathnode->path.pathtype = T_Gather;
+	pathnode->path.parent = rel;
+	pathnode->path.param_info = get_baserel_parampathinfo(root, rel,
+														  required_outer);
+	pathnode->path.pathkeys = NIL;		/* Gather has unordered result */
+
+	pathnode->subpath = subpath;
+	pathnode->num_workers = nworkers;
+
+	cost_gather(pathnode, root, rel, pathnode->path.param_info);
+
+	return pathnode;
+}
+
 /*
  * translate_sub_tlist - get subquery column numbers represented by tlist
  *
@@ -1691,6 +1801,10 @@ create_mergejoin_path(PlannerInfo *root,
  * 'required_outer' is the set of required outer rels
  * 'hashclauses' are the RestrictInfo nodes to use as hash clauses
  *		(this should be a subset of the restrict_clauses list)
+ * 'parallel_hash' is true to load the inner path's output from all
+ *		participants into one shared hash table
+ *
+ * If the outer path is a partial path, so is the result.
  */
 HashPath *
 create_hashjoin_path(PlannerInfo *root,
@@ -1703,7 +1817,8 @@ create_hashjoin_path(PlannerInfo *root,
 					 Path *inner_path,
 					 List *restrict_clauses,
 					 Relids required_outer,
-					 List *hashclauses)
+					 List *hashclauses,
+					 bool parallel_hash)
 {
 	HashPath   *pathnode = makeNode(HashPath);
 
@@ -1734,8 +1849,10 @@ create_hashjoin_path(PlannerInfo *root,
 	pathnode->jpath.outerjoinpath = outer_path;
 	pathnode->jpath.innerjoinpath = inner_path;
 	pathnode->jpath.joinrestrictinfo = restrict_clauses;
+	pathnode->jpath.path.parallel_degree = outer_path->parallel_degree;
 	pathnode->path_hashclauses = hashclauses;
-	/* final_cost_hashjoin will fill in pathnode->num_batches */
+	pathnode->parallel_hash = parallel_hash;
+	/* final_cost_hashjoin will fill in num_batches and inner_rows_total */
 
 	final_cost_hashjoin(root, pathnode, workspace, sjinfo, semifactors);
 
@@ -1772,7 +1889,7 @@ reparameterize_path(PlannerInfo *root, Path *path,
 	switch (path->pathtype)
 	{
 		case T_SeqScan:
-			return create_seqscan_path(root, rel, required_outer);
+			return create_seqscan_path(root, rel, required_outer, 0);
 		case T_IndexScan:
 		case T_IndexOnlyScan:
 			{
@@ -1800,7 +1917,7 @@ reparameterize_path(PlannerInfo *root, Path *path,
 														rel,
 														bpath->bitmapqual,
 														required_outer,
-														loop_count);
+														loop_count, 0);
 			}
 		case T_SubqueryScan:
 			return create_subqueryscan_path(root, rel, path->pathkeys,
@@ -30,11 +30,14 @@
 #include "foreign/fdwapi.h"
 #include "miscadmin.h"
 #include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
 #include "optimizer/clauses.h"
 #include "optimizer/cost.h"
+#include "optimizer/pathnode.h"
 #include "optimizer/plancat.h"
 #include "optimizer/predtest.h"
 #include "optimizer/prep.h"
+#include "optimizer/var.h"
 #include "parser/parse_relation.h"
 #include "parser/parsetree.h"
 #include "rewrite/rewriteManip.h"
@@ -54,6 +57,7 @@ get_relation_info_hook_type get_relation_info_hook = NULL;
 static bool infer_collation_opclass_match(InferenceElem *elem, Relation idxRel,
 							  Bitmapset *inferAttrs, List *idxExprs);
 static int32 get_rel_data_width(Relation rel, int32 *attr_widths);
+static bool contain_extern_params_walker(Node *node, void *context);
 static List *get_relation_constraints(PlannerInfo *root,
 						 Oid relationObjectId, RelOptInfo *rel,
 						 bool include_notnull);
@@ -206,6 +210,7 @@ get_relation_info(PlannerInfo *root, Oid relationObjectId, bool inhparent,
 				RelationGetForm(indexRelation)->reltablespace;
 			info->rel = rel;
 			info->ncolumns = ncolumns = index->indnatts;
+			info->nkeycolumns = index->indnkeyatts;
 			info->indexkeys = (int *) palloc(sizeof(int) * ncolumns);
 			info->indexcollations = (Oid *) palloc(sizeof(Oid) * ncolumns);
 			info->opfamily = (Oid *) palloc(sizeof(Oid) * ncolumns);
@@ -229,6 +234,7 @@ get_relation_info(PlannerInfo *root, Oid relationObjectId, bool inhparent,
 			info->amsearchnulls = indexRelation->rd_am->amsearchnulls;
 			info->amhasgettuple = OidIsValid(indexRelation->rd_am->amgettuple);
 			info->amhasgetbitmap = OidIsValid(indexRelation->rd_am->amgetbitmap);
+			info->amcanparallel = OidIsValid(indexRelation->rd_am->aminitparallelscan);
 
 			/*
 			 * Fetch the ordering information for the index, if any.
@@ -586,8 +592,8 @@ infer_arbiter_indexes(PlannerInfo *root)
 		if (!idxForm->indisunique)
 			goto next;
 
-		/* Build BMS representation of cataloged index attributes */
-		for (natt = 0; natt < idxForm->indnatts; natt++)
+		/* Build BMS representation of cataloged index key attributes */
+		for (natt = 0; natt < idxForm->indnkeyatts; natt++)
 		{
 			int			attno = idxRel->rd_index->indkey.values[natt];
 
@@ -1025,47 +1031,20 @@ get_relation_constraints(PlannerInfo *root,
 	constr = relation->rd_att->constr;
 	if (constr != NULL)
 	{
-		int			num_check = constr->num_check;
 		int			i;
 
-		for (i = 0; i < num_check; i++)
-		{
-			Node	   *cexpr;
-
-			/*
-			 * If this constraint hasn't been fully validated yet, we must
-			 * ignore it here.
-			 */
-			if (!constr->check[i].ccvalid)
-				continue;
-
-			cexpr = stringToNode(constr->check[i].ccbin);
-
-			/*
-			 * Run each expression through const-simplification and
-			 * canonicalization.  This is not just an optimization, but is
-			 * necessary, because we will be comparing it to
-			 * similarly-processed qual clauses, and may fail to detect valid
-			 * matches without this.  This must match the processing done to
-			 * qual clauses in preprocess_expression()!  (We can skip the
-			 * stuff involving subqueries, however, since we don't allow any
-			 * in check constraints.)
-			 */
-			cexpr = eval_const_expressions(root, cexpr);
-
-			cexpr = (Node *) canonicalize_qual((Expr *) cexpr);
-
-			/* Fix Vars to have the desired varno */
-			if (varno != 1)
-				ChangeVarNodes(cexpr, 1, varno, 0);
+		/*
+		 * The relcache keeps the validated CHECK constraints already run
+		 * through the same const-simplification and canonicalization that
+		 * preprocess_expression() applies to qual clauses, so that they can
+		 * be compared.  Doing that on every planning cycle would dominate the
+		 * cost of constraint exclusion over many inheritance children.
+		 */
+		result = RelationGetCheckConstraintExprs(relation);
 
-			/*
-			 * Finally, convert to implicit-AND format (that is, a List) and
-			 * append the resulting item(s) to our output list.
-			 */
-			result = list_concat(result,
-								 make_ands_implicit((Expr *) cexpr));
-		}
+		/* Fix Vars to have the desired varno */
+		if (varno != 1)
+			ChangeVarNodes((Node *) result, 1, varno, 0);
 
 		/* Add NOT NULL constraints in expression form, if requested */
 		if (include_notnull && constr->has_not_null)
@@ -1192,6 +1171,205 @@ relation_excluded_by_constraints(PlannerInfo *root,
 	return false;
 }
 
+/*
+ * get_relation_prune_info
+ *
+ * Collect what the executor needs to repeat the test made by
+ * relation_excluded_by_constraints() for an inheritance child, once the
+ * values of external Params are known.  That's not the case when building
+ * a generic plan, so a child whose restriction clauses compare a column to
+ * a Param can't be excluded at plan time.
+ *
+ * Returns false if there is nothing to gain, because constraint exclusion
+ * is disabled or none of the rel's restriction clauses uses an external
+ * Param.  Otherwise, *quals is set to the immutable restriction clauses,
+ * without RestrictInfos, and *constraints to the immutable constraints.
+ */
+bool
+get_relation_prune_info(PlannerInfo *root, RelOptInfo *rel,
+						List **quals, List **constraints)
+{
+	RangeTblEntry *rte;
+	List	   *safe_restrictions;
+	List	   *constraint_pred;
+	List	   *safe_constraints;
+	bool		have_params;
+	ListCell   *lc;
+
+	*quals = NIL;
+	*constraints = NIL;
+
+	/* Only inheritance children are subject to exclusion at run time */
+	if (constraint_exclusion == CONSTRAINT_EXCLUSION_OFF ||
+		rel->reloptkind != RELOPT_OTHER_MEMBER_REL)
+		return false;
+
+	rte = planner_rt_fetch(rel->relid, root);
+	if (rte->rtekind != RTE_RELATION || rte->inh)
+		return false;
+
+	safe_restrictions = NIL;
+	have_params = false;
+	foreach(lc, rel->baserestrictinfo)
+	{
+		RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+
+		if (contain_mutable_functions((Node *) rinfo->clause))
+			continue;
+		if (contain_extern_params_walker((Node *) rinfo->clause, NULL))
+			have_params = true;
+		safe_restrictions = lappend(safe_restrictions, rinfo->clause);
+	}
+
+	if (!have_params)
+		return false;
+
+	constraint_pred = get_relation_constraints(root, rte->relid, rel, true);
+
+	safe_constraints = NIL;
+	foreach(lc, constraint_pred)
+	{
+		Node	   *pred = (Node *) lfirst(lc);
+
+		if (!contain_mutable_functions(pred))
+			safe_constraints = lappend(safe_constraints, pred);
+	}
+
+	*quals = safe_restrictions;
+	*constraints = safe_constraints;
+	return true;
+}
+
+static bool
+contain_extern_params_walker(Node *node, void *context)
+{
+	if (node == NULL)
+		return false;
+	if (IsA(node, Param))
+		return ((Param *) node)->paramkind == PARAM_EXTERN;
+	return expression_tree_walker(node, contain_extern_params_walker,
+								  context);
+}
+
+/*
+ * appendrel_members_disjoint
+ *
+ * Detect whether no two of the given members of an appendrel can hold the
+ * same value of the parent's column 'attno', judging by the members'
+ * validated CHECK constraints.  If so, all the rows of a group formed on
+ * that column come from a single member.
+ *
+ * The column must be marked NOT NULL in every member, since CHECK
+ * constraints let nulls through.  A member with a constant-false constraint
+ * holds no rows at all, so it can't overlap any other; that lets the parent
+ * table of an inheritance tree take part, given CHECK (false) NO INHERIT.
+ *
+ * Each pair of members costs a proof attempt, so callers should only ask
+ * when there is something to gain.
+ */
+bool
+appendrel_members_disjoint(PlannerInfo *root, Index parent_relid,
+						   AttrNumber attno, List *member_rels)
+{
+	List	   *member_preds = NIL;
+	ListCell   *lc;
+	ListCell   *lc2;
+
+	foreach(lc, member_rels)
+	{
+		RelOptInfo *rel = (RelOptInfo *) lfirst(lc);
+		RangeTblEntry *rte = planner_rt_fetch(rel->relid, root);
+		AppendRelInfo *appinfo;
+		Var		   *childvar;
+		AttrNumber *attno_map;
+		List	   *constraint_pred;
+		List	   *column_pred = NIL;
+		bool		empty = false;
+		bool		notnull = false;
+		bool		found_whole_row;
+
+		if (rte->rtekind != RTE_RELATION || rte->inh)
+			return false;
+
+		appinfo = find_childrel_appendrelinfo(root, rel);
+		Assert(appinfo->parent_relid == parent_relid);
+		childvar = (Var *) list_nth(appinfo->translated_vars, attno - 1);
+		if (childvar == NULL || !IsA(childvar, Var))
+			return false;
+
+		/*
+		 * Keep the immutable constraints that mention only this column.
+		 * Include "col IS NOT NULL" if the column is marked attnotnull.
+		 */
+		constraint_pred = get_relation_constraints(root, rte->relid, rel, true);
+		foreach(lc2, constraint_pred)
+		{
+			Node	   *pred = (Node *) lfirst(lc2);
+			Bitmapset  *attnos = NULL;
+
+			if (contain_mutable_functions(pred))
+				continue;
+
+			if (IsA(pred, Const) &&
+				!((Const *) pred)->constisnull &&
+				!DatumGetBool(((Const *) pred)->constvalue))
+			{
+				empty = true;
+				break;
+			}
+
+			pull_varattnos(pred, rel->relid, &attnos);
+			if (!bms_equal(attnos,
+						   bms_make_singleton(childvar->varattno -
+											  FirstLowInvalidHeapAttributeNumber)))
+				continue;
+
+			if (IsA(pred, NullTest) &&
+				((NullTest *) pred)->nulltesttype == IS_NOT_NULL &&
+				!((NullTest *) pred)->argisrow)
+				notnull = true;
+
+			column_pred = lappend(column_pred, pred);
+		}
+
+		if (empty)
+			continue;
+		if (!notnull)
+			return false;
+
+		/*
+		 * Express the constraints in terms of the parent's column, so that
+		 * those of different members can be compared.
+		 */
+		attno_map = (AttrNumber *) palloc0(childvar->varattno *
+										   sizeof(AttrNumber));
+		attno_map[childvar->varattno - 1] = attno;
+		ChangeVarNodes((Node *) column_pred, rel->relid, parent_relid, 0);
+		column_pred = (List *) map_variable_attnos((Node *) column_pred,
+												   parent_relid, 0,
+												   attno_map,
+												   childvar->varattno,
+												   &found_whole_row);
+		pfree(attno_map);
+
+		member_preds = lappend(member_preds, column_pred);
+	}
+
+	/* Every member's constraints must refute every other member's */
+	foreach(lc, member_preds)
+	{
+		List	   *preds = (List *) lfirst(lc);
+
+		for_each_cell(lc2, lnext(lc))
+		{
+			if (!predicate_refuted_by(preds, (List *) lfirst(lc2)))
+				return false;
+		}
+	}
+
+	return true;
+}
+
 
 /*
  * build_physical_tlist
@@ -1492,7 +1670,7 @@ has_unique_index(RelOptInfo *rel, AttrNumber attno)
 		 * just the specified attr is unique.
 		 */
 		if (index->unique &&
-			index->ncolumns == 1 &&
+			index->nkeycolumns == 1 &&
 			index->indexkeys[0] == attno &&
 			(index->indpred == NIL || index->predOK))
 			return true;
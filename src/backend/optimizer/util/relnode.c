@@ -14,6 +14,7 @@
  */
 #include "postgres.h"
 
+#include "optimizer/clauses.h"
 #include "optimizer/cost.h"
 #include "optimizer/pathnode.h"
 #include "optimizer/paths.h"
@@ -102,8 +103,10 @@ build_simple_rel(PlannerInfo *root, int relid, RelOptKind reloptkind)
 	/* cheap startup cost is interesting iff not all tuples to be retrieved */
 	rel->consider_startup = (root->tuple_fraction > 0);
 	rel->consider_param_startup = false;		/* might get changed later */
+	rel->consider_parallel = false;		/* might get changed later */
 	rel->reltargetlist = NIL;
 	rel->pathlist = NIL;
+	rel->partial_pathlist = NIL;
 	rel->ppilist = NIL;
 	rel->cheapest_startup_path = NULL;
 	rel->cheapest_total_path = NULL;
@@ -130,6 +133,7 @@ build_simple_rel(PlannerInfo *root, int relid, RelOptKind reloptkind)
 	rel->baserestrictcost.per_tuple = 0;
 	rel->joininfo = NIL;
 	rel->has_eclass_joins = false;
+	rel->join_partner_relids = NULL;	/* set later, in make_one_rel */
 
 	/* Check type of rtable entry */
 	switch (rte->rtekind)
@@ -363,8 +367,10 @@ build_join_rel(PlannerInfo *root,
 	/* cheap startup cost is interesting iff not all tuples to be retrieved */
 	joinrel->consider_startup = (root->tuple_fraction > 0);
 	joinrel->consider_param_startup = false;
+	joinrel->consider_parallel = false;
 	joinrel->reltargetlist = NIL;
 	joinrel->pathlist = NIL;
+	joinrel->partial_pathlist = NIL;
 	joinrel->ppilist = NIL;
 	joinrel->cheapest_startup_path = NULL;
 	joinrel->cheapest_total_path = NULL;
@@ -394,6 +400,7 @@ build_join_rel(PlannerInfo *root,
 	joinrel->baserestrictcost.per_tuple = 0;
 	joinrel->joininfo = NIL;
 	joinrel->has_eclass_joins = false;
+	joinrel->join_partner_relids = NULL;
 
 	/*
 	 * Set up foreign-join fields if outer and inner relation are foreign
@@ -435,6 +442,38 @@ build_join_rel(PlannerInfo *root,
 	 */
 	joinrel->has_eclass_joins = has_relevant_eclass_joinclause(root, joinrel);
 
+	/*
+	 * Any rel having a join clause with either input rel, other than the
+	 * rels now joined, has one with the joinrel too; see
+	 * have_relevant_joinclause().
+	 */
+	joinrel->join_partner_relids =
+		bms_difference(bms_union(outer_rel->join_partner_relids,
+								 inner_rel->join_partner_relids),
+					   joinrel->relids);
+
+	/*
+	 * The joinrel can be computed by parallel workers if both its inputs can,
+	 * and nothing we need to evaluate at the join is unsafe to run there.
+	 */
+	if (outer_rel->consider_parallel && inner_rel->consider_parallel &&
+		!has_parallel_hazard((Node *) joinrel->reltargetlist, false))
+	{
+		ListCell   *lc;
+
+		joinrel->consider_parallel = true;
+		foreach(lc, restrictlist)
+		{
+			RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+
+			if (has_parallel_hazard((Node *) rinfo->clause, false))
+			{
+				joinrel->consider_parallel = false;
+				break;
+			}
+		}
+	}
+
 	/*
 	 * Set estimates of the joinrel's size.
 	 */
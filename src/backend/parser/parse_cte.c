@@ -19,6 +19,7 @@
 #include "nodes/nodeFuncs.h"
 #include "parser/analyze.h"
 #include "parser/parse_cte.h"
+#include "parser/parse_oper.h"
 #include "utils/builtins.h"
 #include "utils/lsyscache.h"
 
@@ -80,6 +81,8 @@ typedef struct CteState
 
 
 static void analyzeCTE(ParseState *pstate, CommonTableExpr *cte);
+static void transformCTECycleClause(ParseState *pstate, CommonTableExpr *cte,
+						Query *query);
 
 /* Dependency processing functions */
 static void makeDependencyGraph(CteState *cstate);
@@ -334,6 +337,89 @@ analyzeCTE(ParseState *pstate, CommonTableExpr *cte)
 		if (lctyp != NULL || lctypmod != NULL || lccoll != NULL)		/* shouldn't happen */
 			elog(ERROR, "wrong number of output columns in WITH");
 	}
+
+	if (cte->ctecyclecols != NIL)
+		transformCTECycleClause(pstate, cte, query);
+}
+
+/*
+ * Transform the CYCLE clause of a recursive CTE.
+ *
+ * CYCLE makes the recursive union discard any row whose values in the listed
+ * columns match those of a row it has already produced, whether or not the
+ * other columns match, and whether or not UNION ALL is used.  That stops the
+ * recursion at rows already visited, without tracking the path to each row in
+ * an array.  We identify the columns and their equality operators here, and
+ * store them in the CTE query's top-level SetOperationStmt for the planner.
+ */
+static void
+transformCTECycleClause(ParseState *pstate, CommonTableExpr *cte, Query *query)
+{
+	SetOperationStmt *setop;
+	ListCell   *lc;
+
+	if (!cte->cterecursive)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_RECURSION),
+				 errmsg("CYCLE clause requires a recursive WITH query"),
+				 parser_errposition(pstate, cte->location)));
+
+	setop = (SetOperationStmt *) query->setOperations;
+	Assert(setop && IsA(setop, SetOperationStmt));
+
+	foreach(lc, cte->ctecyclecols)
+	{
+		char	   *colname = strVal(lfirst(lc));
+		SortGroupClause *grpcl;
+		Oid			coltype;
+		Oid			sortop;
+		Oid			eqop;
+		bool		hashable;
+		int			attno;
+		ListCell   *lc2;
+
+		attno = 0;
+		foreach(lc2, cte->ctecolnames)
+		{
+			attno++;
+			if (strcmp(strVal(lfirst(lc2)), colname) == 0)
+				break;
+		}
+		if (lc2 == NULL)
+			ereport(ERROR,
+					(errcode(ERRCODE_UNDEFINED_COLUMN),
+					 errmsg("column \"%s\" specified in CYCLE clause does not exist in WITH query \"%s\"",
+							colname, cte->ctename),
+					 parser_errposition(pstate, cte->location)));
+		if (list_member_int(setop->cycleColIdx, attno))
+			ereport(ERROR,
+					(errcode(ERRCODE_DUPLICATE_COLUMN),
+					 errmsg("column \"%s\" specified more than once in CYCLE clause",
+							colname),
+					 parser_errposition(pstate, cte->location)));
+
+		coltype = list_nth_oid(cte->ctecoltypes, attno - 1);
+		get_sort_group_operators(coltype,
+								 false, true, false,
+								 &sortop, &eqop, NULL,
+								 &hashable);
+		if (!hashable)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("could not identify a hash function for type %s in CYCLE clause",
+							format_type_be(coltype)),
+					 parser_errposition(pstate, cte->location)));
+
+		grpcl = makeNode(SortGroupClause);
+		grpcl->tleSortGroupRef = 0;		/* assigned by the planner */
+		grpcl->eqop = eqop;
+		grpcl->sortop = sortop;
+		grpcl->nulls_first = false;
+		grpcl->hashable = hashable;
+
+		setop->cycleColIdx = lappend_int(setop->cycleColIdx, attno);
+		setop->cycleClauses = lappend(setop->cycleClauses, grpcl);
+	}
 }
 
 /*
@@ -0,0 +1,197 @@
+/*-------------------------------------------------------------------------
+ *
+ * pg_numa.c
+ *	  Placement of shared memory on NUMA nodes.
+ *
+ * We talk to the kernel with raw system calls rather than through libnuma,
+ * since all we need is the list of nodes, the node of the CPU we're running
+ * on, and mbind().  Everything here is a no-op on platforms other than
+ * Linux, where pg_numa_get_nodes reports that nothing is known.
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * IDENTIFICATION
+ *	  src/backend/port/pg_numa.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include "port/pg_numa.h"
+#include "storage/fd.h"
+
+#if defined(__linux__) && defined(SYS_mbind) && defined(SYS_getcpu)
+#define USE_LINUX_NUMA
+#endif
+
+#ifdef USE_LINUX_NUMA
+
+/* from <linux/mempolicy.h>, which isn't always installed */
+#define PG_MPOL_PREFERRED	1
+#define PG_MPOL_INTERLEAVE	3
+
+#define NODEMASK_WORDS \
+	((PG_NUMA_MAX_NODES + 8 * sizeof(unsigned long) - 1) / \
+	 (8 * sizeof(unsigned long)))
+
+static bool
+numa_mbind(void *start, Size len, int mode, const int *nodes, int nnodes)
+{
+	unsigned long nodemask[NODEMASK_WORDS];
+	Size		pagesize = Max((Size) sysconf(_SC_PAGESIZE), PG_NUMA_PAGE_SIZE);
+	char	   *begin;
+	char	   *end;
+	int			i;
+
+	/*
+	 * mbind() works on whole pages only.  We don't know whether the memory
+	 * is backed by huge pages, so play safe and assume it is.
+	 */
+	begin = (char *) TYPEALIGN(pagesize, start);
+	end = (char *) TYPEALIGN_DOWN(pagesize, (char *) start + len);
+	if (end <= begin)
+		return true;
+
+	memset(nodemask, 0, sizeof(nodemask));
+	for (i = 0; i < nnodes; i++)
+	{
+		int			node = nodes[i];
+
+		Assert(node >= 0 && node < PG_NUMA_MAX_NODES);
+		nodemask[node / (8 * sizeof(unsigned long))] |=
+			1UL << (node % (8 * sizeof(unsigned long)));
+	}
+
+	/* the kernel wants the number of bits in the mask, plus one */
+	return syscall(SYS_mbind, begin, (unsigned long) (end - begin), mode,
+				   nodemask, (unsigned long) PG_NUMA_MAX_NODES + 1, 0) == 0;
+}
+#endif   /* USE_LINUX_NUMA */
+
+/*
+ * pg_numa_get_nodes -- get the ids of the online NUMA nodes
+ *
+ * Stores up to maxnodes node ids into nodes[] in ascending order, and
+ * returns how many were stored.  Returns -1 if the information is not
+ * available, which callers should treat as a machine without NUMA.
+ */
+int
+pg_numa_get_nodes(int *nodes, int maxnodes)
+{
+#ifdef USE_LINUX_NUMA
+	FILE	   *file;
+	char		buf[1024];
+	char	   *p;
+	int			nnodes = 0;
+
+	/* The file holds a list of ranges, such as "0-1,4" */
+	file = AllocateFile("/sys/devices/system/node/online", "r");
+	if (file == NULL)
+		return -1;
+	if (fgets(buf, sizeof(buf), file) == NULL)
+	{
+		FreeFile(file);
+		return -1;
+	}
+	FreeFile(file);
+
+	p = buf;
+	while (*p != '\0' && *p != '\n')
+	{
+		long		first;
+		long		last;
+		long		node;
+		char	   *endp;
+
+		first = strtol(p, &endp, 10);
+		if (endp == p)
+			return -1;
+		last = first;
+		p = endp;
+		if (*p == '-')
+		{
+			p++;
+			last = strtol(p, &endp, 10);
+			if (endp == p)
+				return -1;
+			p = endp;
+		}
+		if (*p == ',')
+			p++;
+
+		for (node = first; node <= last; node++)
+		{
+			/* nodes we can't describe in our bitmask are ignored */
+			if (node >= PG_NUMA_MAX_NODES || nnodes >= maxnodes)
+				break;
+			nodes[nnodes++] = (int) node;
+		}
+	}
+
+	return nnodes > 0 ? nnodes : -1;
+#else
+	return -1;
+#endif
+}
+
+/*
+ * pg_numa_current_node -- get the node of the CPU we're running on
+ *
+ * Returns -1 if that can't be determined.  The answer can be out of date
+ * as soon as it's returned, if the scheduler moves us to another CPU.
+ */
+int
+pg_numa_current_node(void)
+{
+#ifdef USE_LINUX_NUMA
+	unsigned int cpu;
+	unsigned int node;
+
+	if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0)
+		return -1;
+	return (int) node;
+#else
+	return -1;
+#endif
+}
+
+/*
+ * pg_numa_bind_memory -- ask for a range of memory to live on one node
+ *
+ * The kernel places pages when they're first touched, so this must be
+ * called before the memory is used.  The node is only preferred, not
+ * required: if it runs out of memory, pages are taken from other nodes
+ * rather than failing.  Partial PG_NUMA_PAGE_SIZE pages at either end of
+ * the range are left alone.  Returns false if the kernel refused.
+ */
+bool
+pg_numa_bind_memory(void *start, Size len, int node)
+{
+#ifdef USE_LINUX_NUMA
+	return numa_mbind(start, len, PG_MPOL_PREFERRED, &node, 1);
+#else
+	return false;
+#endif
+}
+
+/*
+ * pg_numa_interleave_memory -- spread a range of memory over nodes
+ *
+ * Like pg_numa_bind_memory, but pages are assigned round-robin to the
+ * given nodes.
+ */
+bool
+pg_numa_interleave_memory(void *start, Size len, const int *nodes, int nnodes)
+{
+#ifdef USE_LINUX_NUMA
+	return numa_mbind(start, len, PG_MPOL_INTERLEAVE, nodes, nnodes);
+#else
+	return false;
+#endif
+}
@@ -50,6 +50,16 @@
  * there is a window (caused by pgstat delay) on which a worker may choose a
  * table that was already vacuumed; this is a bug in the current design.
  *
+ * Other backends can also ask for specific work to be done in the background
+ * by calling AutoVacuumRequestWork, which puts a work item in shared memory
+ * and asks the launcher for a worker in the requesting database.  Workers
+ * carry out the work items of their database before and after processing
+ * their list of tables.  Such work is moving the pending list of a GIN index
+ * into the main index, so that the inserter that finds the list too long
+ * doesn't have to do it, summarizing a page range of a BRIN index that
+ * inserts have just moved past, and pruning heap pages that a query found
+ * in need of it (see defer_heap_pruning).
+ *
  * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
  * Portions Copyright (c) 1994, Regents of the University of California
  *
@@ -66,6 +76,8 @@
 #include <sys/time.h>
 #include <unistd.h>
 
+#include "access/brin_internal.h"
+#include "access/gin_private.h"
 #include "access/heapam.h"
 #include "access/htup_details.h"
 #include "access/multixact.h"
@@ -180,6 +192,33 @@ typedef struct av_relation
 								 * reloptions, or NULL if none */
 } av_relation;
 
+/*
+ * struct to keep track of tables that look like they need work, in 1st pass.
+ * The array of these is sorted by av_candidate_comparator so that the most
+ * urgent tables are processed first; see relation_needs_vacanalyze for how
+ * ac_priority is computed.
+ */
+typedef struct av_candidate
+{
+	Oid			ac_relid;
+	bool		ac_wraparound;	/* vacuum forced to prevent wraparound? */
+	double		ac_priority;	/* larger is more urgent */
+	BlockNumber ac_relpages;	/* pg_class.relpages, to spot big tables */
+} av_candidate;
+
+/*
+ * A worker that starts on a table at least this large asks the launcher to
+ * start another worker in its database right away, so that the rest of its
+ * list isn't stuck behind one long vacuum.
+ */
+#define AV_HANDOFF_MIN_PAGES	((BlockNumber) ((1024 * 1024 * 1024) / BLCKSZ))
+
+/*
+ * Relative share of the cost budget given to a worker doing an
+ * anti-wraparound vacuum, compared to one doing ordinary work.
+ */
+#define AV_WRAPAROUND_COST_WEIGHT	2.0
+
 /* struct to keep track of tables to vacuum and/or analyze, after rechecking */
 typedef struct autovac_table
 {
@@ -204,6 +243,7 @@ typedef struct autovac_table
  * wi_tableoid	OID of the table currently being vacuumed, if any
  * wi_proc		pointer to PGPROC of the running worker, NULL if not started
  * wi_launchtime Time at which this worker was launched
+ * wi_wraparound whether the current table is vacuumed to prevent wraparound
  * wi_cost_*	Vacuum cost-based delay parameters current in this worker
  *
  * All fields are protected by AutovacuumLock, except for wi_tableoid which is
@@ -218,6 +258,7 @@ typedef struct WorkerInfoData
 	Oid			wi_tableoid;
 	PGPROC	   *wi_proc;
 	TimestampTz wi_launchtime;
+	bool		wi_wraparound;
 	bool		wi_dobalance;
 	int			wi_cost_delay;
 	int			wi_cost_limit;
@@ -238,6 +279,24 @@ typedef enum
 	AutoVacNumSignals			/* must be last */
 }	AutoVacuumSignal;
 
+/*
+ * A piece of work requested by some other process, to be done by a worker
+ * connected to avw_database.  avw_used means the slot holds a request, and
+ * avw_active that a worker is carrying it out.  avw_blockNumber is only used
+ * by some types of work.
+ */
+typedef struct AutoVacuumWorkItem
+{
+	AutoVacuumWorkItemType avw_type;
+	bool		avw_used;
+	bool		avw_active;
+	Oid			avw_database;
+	Oid			avw_relation;
+	BlockNumber avw_blockNumber;
+} AutoVacuumWorkItem;
+
+#define AV_NUM_WORKITEMS	256
+
 /*-------------
  * The main autovacuum shmem struct.  On shared memory we store this main
  * struct and the array of WorkerInfo structs.  This struct keeps:
@@ -248,6 +307,10 @@ typedef enum
  * av_runningWorkers the WorkerInfo non-free queue
  * av_startingWorker pointer to WorkerInfo currently being started (cleared by
  *					the worker itself as soon as it's up and running)
+ * av_handoffDatabase database in which a worker busy with a big table has asked
+ *					for help; the launcher starts a worker there as soon as it
+ *					can, then resets this to InvalidOid
+ * av_workItems		work item array, filled by AutoVacuumRequestWork
  *
  * This struct is protected by AutovacuumLock, except for av_signal and parts
  * of the worker list (see above).
@@ -260,6 +323,8 @@ typedef struct
 	dlist_head	av_freeWorkers;
 	dlist_head	av_runningWorkers;
 	WorkerInfo	av_startingWorker;
+	Oid			av_handoffDatabase;
+	AutoVacuumWorkItem av_workItems[AV_NUM_WORKITEMS];
 } AutoVacuumShmemStruct;
 
 static AutoVacuumShmemStruct *AutoVacuumShmem;
@@ -299,11 +364,26 @@ static void FreeWorkerInfo(int code, Datum arg);
 static autovac_table *table_recheck_autovac(Oid relid, HTAB *table_toast_map,
 					  TupleDesc pg_class_desc,
 					  int effective_multixact_freeze_max_age);
+static void recheck_relation_needs_vacanalyze(Oid relid, AutoVacOpts *avopts,
+								  Form_pg_class classForm,
+								  int effective_multixact_freeze_max_age,
+								  bool *dovacuum, bool *doanalyze,
+								  bool *wraparound);
+static void av_add_candidate(av_candidate **candidates, int *ncandidates,
+				 int *maxcandidates, Oid relid, bool wraparound,
+				 double priority, BlockNumber relpages);
+static int	av_candidate_comparator(const void *a, const void *b);
+static void autovac_request_handoff(void);
+static void autovac_do_work_items(void);
+static void perform_work_item(AutoVacuumWorkItem *workitem);
+static void autovac_report_workitem(AutoVacuumWorkItem *workitem,
+						const char *nspname, const char *relname);
 static void relation_needs_vacanalyze(Oid relid, AutoVacOpts *relopts,
 						  Form_pg_class classForm,
 						  PgStat_StatTabEntry *tabentry,
 						  int effective_multixact_freeze_max_age,
-						  bool *dovacuum, bool *doanalyze, bool *wraparound);
+						  bool *dovacuum, bool *doanalyze, bool *wraparound,
+						  double *priority);
 
 static void autovacuum_do_vac_analyze(autovac_table *tab,
 						  BufferAccessStrategy bstrategy);
@@ -576,6 +656,7 @@ AutoVacLauncherMain(int argc, char *argv[])
 		struct timeval nap;
 		TimestampTz current_time = 0;
 		bool		can_launch;
+		bool		handoff_pending;
 		int			rc;
 
 		/*
@@ -677,6 +758,7 @@ AutoVacLauncherMain(int argc, char *argv[])
 		LWLockAcquire(AutovacuumLock, LW_SHARED);
 
 		can_launch = !dlist_is_empty(&AutoVacuumShmem->av_freeWorkers);
+		handoff_pending = OidIsValid(AutoVacuumShmem->av_handoffDatabase);
 
 		if (AutoVacuumShmem->av_startingWorker != NULL)
 		{
@@ -718,6 +800,7 @@ AutoVacLauncherMain(int argc, char *argv[])
 					worker->wi_tableoid = InvalidOid;
 					worker->wi_proc = NULL;
 					worker->wi_launchtime = 0;
+					worker->wi_wraparound = false;
 					dlist_push_head(&AutoVacuumShmem->av_freeWorkers,
 									&worker->wi_links);
 					AutoVacuumShmem->av_startingWorker = NULL;
@@ -760,9 +843,10 @@ AutoVacLauncherMain(int argc, char *argv[])
 
 			/*
 			 * launch a worker if next_worker is right now or it is in the
-			 * past
+			 * past, or if a worker has asked for help with its database
 			 */
-			if (TimestampDifferenceExceeds(avdb->adl_next_worker,
+			if (handoff_pending ||
+				TimestampDifferenceExceeds(avdb->adl_next_worker,
 										   current_time, 0))
 				launch_worker(current_time);
 		}
@@ -1077,6 +1161,7 @@ do_start_worker(void)
 	TimestampTz current_time;
 	bool		skipit = false;
 	Oid			retval = InvalidOid;
+	Oid			handoff_db;
 	MemoryContext tmpcxt,
 				oldcxt;
 
@@ -1228,6 +1313,40 @@ do_start_worker(void)
 			avdb = tmp;
 	}
 
+	/*
+	 * If a worker busy with a big table has asked for help, and no database
+	 * is in danger of wraparound, send the new worker there regardless of
+	 * when that database was last processed.  If the database has gone
+	 * away, forget the request.
+	 */
+	LWLockAcquire(AutovacuumLock, LW_SHARED);
+	handoff_db = AutoVacuumShmem->av_handoffDatabase;
+	LWLockRelease(AutovacuumLock);
+	if (OidIsValid(handoff_db) && !for_xid_wrap && !for_multi_wrap)
+	{
+		bool		found = false;
+
+		foreach(cell, dblist)
+		{
+			avw_dbase  *tmp = lfirst(cell);
+
+			if (tmp->adw_datid == handoff_db)
+			{
+				avdb = tmp;
+				found = true;
+				break;
+			}
+		}
+
+		if (!found)
+		{
+			LWLockAcquire(AutovacuumLock, LW_EXCLUSIVE);
+			if (AutoVacuumShmem->av_handoffDatabase == handoff_db)
+				AutoVacuumShmem->av_handoffDatabase = InvalidOid;
+			LWLockRelease(AutovacuumLock);
+		}
+	}
+
 	/* Found a database -- process it */
 	if (avdb != NULL)
 	{
@@ -1236,6 +1355,10 @@ do_start_worker(void)
 
 		LWLockAcquire(AutovacuumLock, LW_EXCLUSIVE);
 
+		/* the request for help, if any, is satisfied by this worker */
+		if (AutoVacuumShmem->av_handoffDatabase == avdb->adw_datid)
+			AutoVacuumShmem->av_handoffDatabase = InvalidOid;
+
 		/*
 		 * Get a worker entry from the freelist.  We checked above, so there
 		 * really should be a free slot.
@@ -1675,6 +1798,7 @@ FreeWorkerInfo(int code, Datum arg)
 		MyWorkerInfo->wi_tableoid = InvalidOid;
 		MyWorkerInfo->wi_proc = NULL;
 		MyWorkerInfo->wi_launchtime = 0;
+		MyWorkerInfo->wi_wraparound = false;
 		MyWorkerInfo->wi_dobalance = false;
 		MyWorkerInfo->wi_cost_delay = 0;
 		MyWorkerInfo->wi_cost_limit = 0;
@@ -1745,7 +1869,7 @@ autovac_balance_cost(void)
 		if (worker->wi_proc != NULL &&
 			worker->wi_dobalance &&
 			worker->wi_cost_limit_base > 0 && worker->wi_cost_delay > 0)
-			cost_total +=
+			cost_total += (worker->wi_wraparound ? AV_WRAPAROUND_COST_WEIGHT : 1.0) *
 				(double) worker->wi_cost_limit_base / worker->wi_cost_delay;
 	}
 
@@ -1755,7 +1879,8 @@ autovac_balance_cost(void)
 
 	/*
 	 * Adjust cost limit of each active worker to balance the total of cost
-	 * limit to autovacuum_vacuum_cost_limit.
+	 * limit to autovacuum_vacuum_cost_limit.  Workers vacuuming to prevent
+	 * wraparound get a larger share, since that work can't be put off.
 	 */
 	cost_avail = (double) vac_cost_limit / vac_cost_delay;
 	dlist_foreach(iter, &AutoVacuumShmem->av_runningWorkers)
@@ -1766,8 +1891,10 @@ autovac_balance_cost(void)
 			worker->wi_dobalance &&
 			worker->wi_cost_limit_base > 0 && worker->wi_cost_delay > 0)
 		{
+			double		weight = worker->wi_wraparound ?
+			AV_WRAPAROUND_COST_WEIGHT : 1.0;
 			int			limit = (int)
-			(cost_avail * worker->wi_cost_limit_base / cost_total);
+			(cost_avail * weight * worker->wi_cost_limit_base / cost_total);
 
 			/*
 			 * We put a lower bound of 1 on the cost_limit, to avoid division-
@@ -1874,10 +2001,13 @@ do_autovacuum(void)
 	HeapTuple	tuple;
 	HeapScanDesc relScan;
 	Form_pg_database dbForm;
-	List	   *table_oids = NIL;
+	av_candidate *candidates;
+	int			ncandidates = 0;
+	int			maxcandidates;
+	volatile int candidx;
+	bool		handoff_requested = false;
 	HASHCTL		ctl;
 	HTAB	   *table_toast_map;
-	ListCell   *volatile cell;
 	PgStat_StatDBEntry *shared;
 	PgStat_StatDBEntry *dbentry;
 	BufferAccessStrategy bstrategy;
@@ -1950,6 +2080,9 @@ do_autovacuum(void)
 	/* StartTransactionCommand changed elsewhere */
 	MemoryContextSwitchTo(AutovacMemCxt);
 
+	maxcandidates = 64;
+	candidates = (av_candidate *) palloc(maxcandidates * sizeof(av_candidate));
+
 	/* The database hash where pgstat keeps shared relations */
 	shared = pgstat_fetch_stat_dbentry(InvalidOid);
 
@@ -1997,6 +2130,7 @@ do_autovacuum(void)
 		bool		dovacuum;
 		bool		doanalyze;
 		bool		wraparound;
+		double		priority;
 
 		if (classForm->relkind != RELKIND_RELATION &&
 			classForm->relkind != RELKIND_MATVIEW)
@@ -2012,7 +2146,8 @@ do_autovacuum(void)
 		/* Check if it needs vacuum or analyze */
 		relation_needs_vacanalyze(relid, relopts, classForm, tabentry,
 								  effective_multixact_freeze_max_age,
-								  &dovacuum, &doanalyze, &wraparound);
+								  &dovacuum, &doanalyze, &wraparound,
+								  &priority);
 
 		/*
 		 * Check if it is a temp table (presumably, of some other backend's).
@@ -2059,9 +2194,11 @@ do_autovacuum(void)
 		}
 		else
 		{
-			/* relations that need work are added to table_oids */
+			/* relations that need work are added to the candidates */
 			if (dovacuum || doanalyze)
-				table_oids = lappend_oid(table_oids, relid);
+				av_add_candidate(&candidates, &ncandidates, &maxcandidates,
+								 relid, wraparound, priority,
+								 classForm->relpages);
 
 			/*
 			 * Remember the association for the second pass.  Note: we must do
@@ -2111,6 +2248,7 @@ do_autovacuum(void)
 		bool		dovacuum;
 		bool		doanalyze;
 		bool		wraparound;
+		double		priority;
 
 		/*
 		 * We cannot safely process other backends' temp tables, so skip 'em.
@@ -2141,16 +2279,29 @@ do_autovacuum(void)
 
 		relation_needs_vacanalyze(relid, relopts, classForm, tabentry,
 								  effective_multixact_freeze_max_age,
-								  &dovacuum, &doanalyze, &wraparound);
+								  &dovacuum, &doanalyze, &wraparound,
+								  &priority);
 
 		/* ignore analyze for toast tables */
 		if (dovacuum)
-			table_oids = lappend_oid(table_oids, relid);
+			av_add_candidate(&candidates, &ncandidates, &maxcandidates,
+							 relid, wraparound, priority,
+							 classForm->relpages);
 	}
 
 	heap_endscan(relScan);
 	heap_close(classRel, AccessShareLock);
 
+	/*
+	 * Process the most urgent tables first: those in danger of wraparound,
+	 * oldest first, and then the rest by how far past their thresholds they
+	 * are.  Otherwise a table that badly needs attention could wait behind
+	 * every table that happens to precede it in pg_class.
+	 */
+	if (ncandidates > 1)
+		qsort(candidates, ncandidates, sizeof(av_candidate),
+			  av_candidate_comparator);
+
 	/*
 	 * Create a buffer access strategy object for VACUUM to use.  We want to
 	 * use the same one across all the vacuum operations we perform, since the
@@ -2171,9 +2322,12 @@ do_autovacuum(void)
 	/*
 	 * Perform operations on collected tables.
 	 */
-	foreach(cell, table_oids)
+	/* Requested work is presumably urgent, so do it before any tables */
+	autovac_do_work_items();
+
+	for (candidx = 0; candidx < ncandidates; candidx++)
 	{
-		Oid			relid = lfirst_oid(cell);
+		Oid			relid = candidates[candidx].ac_relid;
 		autovac_table *tab;
 		bool		skipit;
 		int			stdVacuumCostDelay;
@@ -2275,6 +2429,7 @@ do_autovacuum(void)
 		LWLockAcquire(AutovacuumLock, LW_EXCLUSIVE);
 
 		/* advertise my cost delay parameters for the balancing algorithm */
+		MyWorkerInfo->wi_wraparound = tab->at_params.is_wraparound;
 		MyWorkerInfo->wi_dobalance = tab->at_dobalance;
 		MyWorkerInfo->wi_cost_delay = tab->at_vacuum_cost_delay;
 		MyWorkerInfo->wi_cost_limit = tab->at_vacuum_cost_limit;
@@ -2289,6 +2444,21 @@ do_autovacuum(void)
 		/* done */
 		LWLockRelease(AutovacuumLock);
 
+		/*
+		 * If this table is big enough to keep us busy for a long while and
+		 * there is more on our list, get another worker started in this
+		 * database so that the remaining tables don't have to wait for us.
+		 * Once per worker is enough: the helper builds its own list.
+		 */
+		if (!handoff_requested &&
+			(tab->at_vacoptions & VACOPT_VACUUM) &&
+			candidates[candidx].ac_relpages >= AV_HANDOFF_MIN_PAGES &&
+			candidx < ncandidates - 1)
+		{
+			autovac_request_handoff();
+			handoff_requested = true;
+		}
+
 		/* clean up memory before each iteration */
 		MemoryContextResetAndDeleteChildren(PortalContext);
 
@@ -2379,6 +2549,9 @@ deleted:
 		VacuumCostLimit = stdVacuumCostLimit;
 	}
 
+	/* Pick up work requested while we were busy with the tables */
+	autovac_do_work_items();
+
 	/*
 	 * We leak table_toast_map here (among other things), but since we're
 	 * going away soon, it's not a problem.
@@ -2394,6 +2567,205 @@ deleted:
 	CommitTransactionCommand();
 }
 
+/*
+ * av_add_candidate
+ *		Append a table to the array of tables that need work.
+ */
+static void
+av_add_candidate(av_candidate **candidates, int *ncandidates,
+				 int *maxcandidates, Oid relid, bool wraparound,
+				 double priority, BlockNumber relpages)
+{
+	av_candidate *cand;
+
+	if (*ncandidates >= *maxcandidates)
+	{
+		*maxcandidates *= 2;
+		*candidates = (av_candidate *)
+			repalloc(*candidates, *maxcandidates * sizeof(av_candidate));
+	}
+
+	cand = &(*candidates)[(*ncandidates)++];
+	cand->ac_relid = relid;
+	cand->ac_wraparound = wraparound;
+	cand->ac_priority = priority;
+	cand->ac_relpages = relpages;
+}
+
+/*
+ * qsort comparator for av_candidate: wraparound vacuums sort first, then
+ * higher priority before lower.  Ties are broken by OID so that the order
+ * is deterministic.
+ */
+static int
+av_candidate_comparator(const void *a, const void *b)
+{
+	const av_candidate *ca = (const av_candidate *) a;
+	const av_candidate *cb = (const av_candidate *) b;
+
+	if (ca->ac_wraparound != cb->ac_wraparound)
+		return ca->ac_wraparound ? -1 : 1;
+	if (ca->ac_priority != cb->ac_priority)
+		return (ca->ac_priority > cb->ac_priority) ? -1 : 1;
+	if (ca->ac_relid != cb->ac_relid)
+		return (ca->ac_relid < cb->ac_relid) ? -1 : 1;
+	return 0;
+}
+
+/*
+ * autovac_request_handoff
+ *		Ask the launcher to start another worker in our database.
+ *
+ * Used by a worker that is about to spend a long time on a single table while
+ * other tables on its list still need attention.
+ */
+static void
+autovac_request_handoff(void)
+{
+	pid_t		launcherpid;
+
+	LWLockAcquire(AutovacuumLock, LW_EXCLUSIVE);
+	AutoVacuumShmem->av_handoffDatabase = MyDatabaseId;
+	launcherpid = AutoVacuumShmem->av_launcherpid;
+	LWLockRelease(AutovacuumLock);
+
+	if (launcherpid != 0)
+		kill(launcherpid, SIGUSR2);
+}
+
+/*
+ * autovac_do_work_items
+ *		Carry out the work items that have been requested in our database.
+ */
+static void
+autovac_do_work_items(void)
+{
+	int			i;
+
+	LWLockAcquire(AutovacuumLock, LW_EXCLUSIVE);
+	for (i = 0; i < AV_NUM_WORKITEMS; i++)
+	{
+		AutoVacuumWorkItem *workitem = &AutoVacuumShmem->av_workItems[i];
+
+		if (!workitem->avw_used || workitem->avw_active ||
+			workitem->avw_database != MyDatabaseId)
+			continue;
+
+		/* claim it, so that no other worker does it too */
+		workitem->avw_active = true;
+		LWLockRelease(AutovacuumLock);
+
+		perform_work_item(workitem);
+
+		CHECK_FOR_INTERRUPTS();
+
+		LWLockAcquire(AutovacuumLock, LW_EXCLUSIVE);
+		workitem->avw_active = false;
+		workitem->avw_used = false;
+	}
+	LWLockRelease(AutovacuumLock);
+}
+
+/*
+ * perform_work_item
+ *		Execute one work item, which we have marked active.
+ *
+ * Errors are reported and otherwise ignored, as for tables.
+ */
+static void
+perform_work_item(AutoVacuumWorkItem *workitem)
+{
+	char	   *cur_datname;
+	char	   *cur_nspname;
+	char	   *cur_relname;
+
+	MemoryContextSwitchTo(AutovacMemCxt);
+
+	/* clean up memory before each work item */
+	MemoryContextResetAndDeleteChildren(PortalContext);
+
+	/*
+	 * Save the relation name for a possible error message, as for tables.  If
+	 * the relation has been dropped since the request was made, or was
+	 * created by a transaction we can't see yet, just forget about it; the
+	 * requester will ask again if it still needs the work done.
+	 */
+	cur_relname = get_rel_name(workitem->avw_relation);
+	cur_nspname = get_namespace_name(get_rel_namespace(workitem->avw_relation));
+	cur_datname = get_database_name(MyDatabaseId);
+	if (!cur_relname || !cur_nspname || !cur_datname)
+		goto deleted;
+
+	autovac_report_workitem(workitem, cur_nspname, cur_relname);
+
+	PG_TRY();
+	{
+		MemoryContextSwitchTo(TopTransactionContext);
+
+		switch (workitem->avw_type)
+		{
+			case AVW_GINCleanPendingList:
+				DirectFunctionCall1(gin_clean_pending_list,
+									ObjectIdGetDatum(workitem->avw_relation));
+				break;
+			case AVW_BRINSummarizeRange:
+				DirectFunctionCall2(brin_summarize_range,
+									ObjectIdGetDatum(workitem->avw_relation),
+							Int64GetDatum((int64) workitem->avw_blockNumber));
+				break;
+			case AVW_HeapPruneRange:
+				heap_prune_range(workitem->avw_relation,
+								 workitem->avw_blockNumber);
+				break;
+			default:
+				elog(WARNING, "unrecognized autovacuum work item type: %d",
+					 (int) workitem->avw_type);
+				break;
+		}
+
+		/* see the corresponding comment for tables */
+		QueryCancelPending = false;
+	}
+	PG_CATCH();
+	{
+		/*
+		 * Abort the transaction, start a new one, and proceed with the next
+		 * work item or table.
+		 */
+		HOLD_INTERRUPTS();
+		if (workitem->avw_type == AVW_BRINSummarizeRange)
+			errcontext("automatic summarization of range %u of BRIN index \"%s.%s.%s\"",
+					   workitem->avw_blockNumber,
+					   cur_datname, cur_nspname, cur_relname);
+		else if (workitem->avw_type == AVW_HeapPruneRange)
+			errcontext("automatic pruning of pages from %u of table \"%s.%s.%s\"",
+					   workitem->avw_blockNumber,
+					   cur_datname, cur_nspname, cur_relname);
+		else
+			errcontext("automatic cleanup of GIN pending list of index \"%s.%s.%s\"",
+					   cur_datname, cur_nspname, cur_relname);
+		EmitErrorReport();
+
+		AbortOutOfAnyTransaction();
+		FlushErrorState();
+		MemoryContextResetAndDeleteChildren(PortalContext);
+
+		StartTransactionCommand();
+		RESUME_INTERRUPTS();
+	}
+	PG_END_TRY();
+
+	MemoryContextSwitchTo(AutovacMemCxt);
+
+deleted:
+	if (cur_datname != NULL)
+		pfree(cur_datname);
+	if (cur_nspname != NULL)
+		pfree(cur_nspname);
+	if (cur_relname != NULL)
+		pfree(cur_relname);
+}
+
 /*
  * extract_autovac_opts
  *
@@ -2463,18 +2835,9 @@ table_recheck_autovac(Oid relid, HTAB *table_toast_map,
 	bool		dovacuum;
 	bool		doanalyze;
 	autovac_table *tab = NULL;
-	PgStat_StatTabEntry *tabentry;
-	PgStat_StatDBEntry *shared;
-	PgStat_StatDBEntry *dbentry;
 	bool		wraparound;
 	AutoVacOpts *avopts;
 
-	/* use fresh stats */
-	autovac_refresh_stats();
-
-	shared = pgstat_fetch_stat_dbentry(InvalidOid);
-	dbentry = pgstat_fetch_stat_dbentry(MyDatabaseId);
-
 	/* fetch the relation's relcache entry */
 	classTup = SearchSysCacheCopy1(RELOID, ObjectIdGetDatum(relid));
 	if (!HeapTupleIsValid(classTup))
@@ -2497,17 +2860,30 @@ table_recheck_autovac(Oid relid, HTAB *table_toast_map,
 			avopts = &hentry->ar_reloptions;
 	}
 
-	/* fetch the pgstat table entry */
-	tabentry = get_pgstat_tabentry_relid(relid, classForm->relisshared,
-										 shared, dbentry);
+	/*
+	 * Check with the stats we already have first.  Rereading the stats file
+	 * is expensive when there are many tables, and most tables on our list
+	 * need processing as much as they did when the list was made; so only
+	 * if this says the table still needs work do we pay for fresh stats, to
+	 * recheck in case some other worker has just processed it.
+	 */
+	recheck_relation_needs_vacanalyze(relid, avopts, classForm,
+									  effective_multixact_freeze_max_age,
+									  &dovacuum, &doanalyze, &wraparound);
 
-	relation_needs_vacanalyze(relid, avopts, classForm, tabentry,
-							  effective_multixact_freeze_max_age,
-							  &dovacuum, &doanalyze, &wraparound);
+	/* Quick exit if it doesn't need to be vacuumed or analyzed */
+	if (!doanalyze && !dovacuum)
+	{
+		heap_freetuple(classTup);
+		return NULL;
+	}
 
-	/* ignore ANALYZE for toast tables */
-	if (classForm->relkind == RELKIND_TOASTVALUE)
-		doanalyze = false;
+	/* use fresh stats and check again */
+	autovac_refresh_stats();
+
+	recheck_relation_needs_vacanalyze(relid, avopts, classForm,
+									  effective_multixact_freeze_max_age,
+									  &dovacuum, &doanalyze, &wraparound);
 
 	/* OK, it needs something done */
 	if (doanalyze || dovacuum)
@@ -2597,6 +2973,42 @@ table_recheck_autovac(Oid relid, HTAB *table_toast_map,
 	return tab;
 }
 
+/*
+ * recheck_relation_needs_vacanalyze
+ *
+ * Subroutine for table_recheck_autovac: fetch the relation's pgstat entry
+ * from the current stats snapshot, and see whether it needs vacuum or
+ * analyze.
+ */
+static void
+recheck_relation_needs_vacanalyze(Oid relid,
+								  AutoVacOpts *avopts,
+								  Form_pg_class classForm,
+								  int effective_multixact_freeze_max_age,
+								  bool *dovacuum,
+								  bool *doanalyze,
+								  bool *wraparound)
+{
+	PgStat_StatTabEntry *tabentry;
+	PgStat_StatDBEntry *shared;
+	PgStat_StatDBEntry *dbentry;
+
+	shared = pgstat_fetch_stat_dbentry(InvalidOid);
+	dbentry = pgstat_fetch_stat_dbentry(MyDatabaseId);
+
+	/* fetch the pgstat table entry */
+	tabentry = get_pgstat_tabentry_relid(relid, classForm->relisshared,
+										 shared, dbentry);
+
+	relation_needs_vacanalyze(relid, avopts, classForm, tabentry,
+							  effective_multixact_freeze_max_age,
+							  dovacuum, doanalyze, wraparound, NULL);
+
+	/* ignore ANALYZE for toast tables */
+	if (classForm->relkind == RELKIND_TOASTVALUE)
+		*doanalyze = false;
+}
+
 /*
  * relation_needs_vacanalyze
  *
@@ -2604,6 +3016,13 @@ table_recheck_autovac(Oid relid, HTAB *table_toast_map,
  * "dovacuum" and "doanalyze", respectively.  Also return whether the vacuum is
  * being forced because of Xid or multixact wraparound.
  *
+ * If priority isn't NULL, it is set to a measure of how urgently the table
+ * needs work, used to order the tables a worker processes.  For a table
+ * vacuumed to prevent wraparound, it is the larger of the ages of its
+ * relfrozenxid and relminmxid as a fraction of the corresponding freeze max
+ * age (so at least 1); otherwise it is the larger of the ratios of dead and
+ * changed tuples to the vacuum and analyze thresholds.
+ *
  * relopts is a pointer to the AutoVacOpts options (either for itself in the
  * case of a plain table, or for either itself or its parent table in the case
  * of a TOAST table), NULL if none; tabentry is the pgstats entry, which can be
@@ -2643,7 +3062,8 @@ relation_needs_vacanalyze(Oid relid,
  /* output params below */
 						  bool *dovacuum,
 						  bool *doanalyze,
-						  bool *wraparound)
+						  bool *wraparound,
+						  double *priority)
 {
 	bool		force_vacuum;
 	bool		av_enabled;
@@ -2672,6 +3092,9 @@ relation_needs_vacanalyze(Oid relid,
 	AssertArg(classForm != NULL);
 	AssertArg(OidIsValid(relid));
 
+	if (priority)
+		*priority = 0.0;
+
 	/*
 	 * Determine vacuum/analyze equation parameters.  We have two possible
 	 * sources: the passed reloptions (which could be a main table or a toast
@@ -2722,6 +3145,20 @@ relation_needs_vacanalyze(Oid relid,
 	}
 	*wraparound = force_vacuum;
 
+	if (force_vacuum && priority)
+	{
+		double		xid_age = 0.0;
+		double		multi_age = 0.0;
+
+		if (TransactionIdIsNormal(classForm->relfrozenxid))
+			xid_age = (double) (recentXid - classForm->relfrozenxid) /
+				Max(freeze_max_age, 1);
+		if (MultiXactIdIsValid(classForm->relminmxid))
+			multi_age = (double) (recentMulti - classForm->relminmxid) /
+				Max(multixact_freeze_max_age, 1);
+		*priority = Max(xid_age, multi_age);
+	}
+
 	/* User disabled it in pg_class.reloptions?  (But ignore if at risk) */
 	if (!av_enabled && !force_vacuum)
 	{
@@ -2758,6 +3195,10 @@ relation_needs_vacanalyze(Oid relid,
 		/* Determine if this table needs vacuum or analyze. */
 		*dovacuum = force_vacuum || (vactuples > vacthresh);
 		*doanalyze = (anltuples > anlthresh);
+
+		if (!force_vacuum && priority)
+			*priority = Max(vactuples / Max(vacthresh, 1.0),
+							anltuples / Max(anlthresh, 1.0));
 	}
 	else
 	{
@@ -2840,6 +3281,126 @@ autovac_report_activity(autovac_table *tab)
 	pgstat_report_activity(STATE_RUNNING, activity);
 }
 
+/*
+ * autovac_report_workitem
+ *		Report to pgstat that a work item is being processed
+ */
+static void
+autovac_report_workitem(AutoVacuumWorkItem *workitem,
+						const char *nspname, const char *relname)
+{
+	char		activity[MAX_AUTOVAC_ACTIV_LEN];
+
+	switch (workitem->avw_type)
+	{
+		case AVW_GINCleanPendingList:
+			snprintf(activity, MAX_AUTOVAC_ACTIV_LEN,
+					 "autovacuum: GIN pending list cleanup %s.%s",
+					 nspname, relname);
+			break;
+		case AVW_BRINSummarizeRange:
+			snprintf(activity, MAX_AUTOVAC_ACTIV_LEN,
+					 "autovacuum: BRIN summarize %s.%s %u",
+					 nspname, relname, workitem->avw_blockNumber);
+			break;
+		case AVW_HeapPruneRange:
+			snprintf(activity, MAX_AUTOVAC_ACTIV_LEN,
+					 "autovacuum: prune %s.%s %u",
+					 nspname, relname, workitem->avw_blockNumber);
+			break;
+		default:
+			snprintf(activity, MAX_AUTOVAC_ACTIV_LEN,
+					 "autovacuum: work item %s.%s", nspname, relname);
+			break;
+	}
+
+	/* Set statement_timestamp() to current time for pg_stat_activity */
+	SetCurrentStatementStartTimestamp();
+
+	pgstat_report_activity(STATE_RUNNING, activity);
+}
+
+/*
+ * AutoVacuumRequestWork
+ *		Ask an autovacuum worker to do some work on a relation of our
+ *		database.  blkno is InvalidBlockNumber unless the type of work needs
+ *		it.
+ *
+ * Returns false if the work can't be queued, because autovacuum is disabled
+ * or too much work is already queued; the caller should then do the work
+ * itself.  A request for work that is already queued is merged into it.
+ */
+bool
+AutoVacuumRequestWork(AutoVacuumWorkItemType type, Oid relationId,
+					  BlockNumber blkno)
+{
+	AutoVacuumWorkItem *freeitem = NULL;
+	bool		signal_launcher = false;
+	pid_t		launcherpid = 0;
+	bool		result = false;
+	int			i;
+
+	if (!AutoVacuumingActive())
+		return false;
+
+	LWLockAcquire(AutovacuumLock, LW_EXCLUSIVE);
+
+	for (i = 0; i < AV_NUM_WORKITEMS; i++)
+	{
+		AutoVacuumWorkItem *workitem = &AutoVacuumShmem->av_workItems[i];
+
+		if (!workitem->avw_used)
+		{
+			if (freeitem == NULL)
+				freeitem = workitem;
+			continue;
+		}
+
+		/*
+		 * A matching item that is already being worked on might have got
+		 * past the point where our request would make a difference, so it
+		 * doesn't count.
+		 */
+		if (!workitem->avw_active && workitem->avw_type == type &&
+			workitem->avw_database == MyDatabaseId &&
+			workitem->avw_relation == relationId &&
+			workitem->avw_blockNumber == blkno)
+		{
+			result = true;
+			break;
+		}
+	}
+
+	if (!result && freeitem != NULL)
+	{
+		freeitem->avw_type = type;
+		freeitem->avw_used = true;
+		freeitem->avw_active = false;
+		freeitem->avw_database = MyDatabaseId;
+		freeitem->avw_relation = relationId;
+		freeitem->avw_blockNumber = blkno;
+		result = true;
+
+		/*
+		 * Get a worker started here soon, using the hand-off request
+		 * mechanism, unless some other database's request is pending.
+		 */
+		if (!OidIsValid(AutoVacuumShmem->av_handoffDatabase))
+		{
+			AutoVacuumShmem->av_handoffDatabase = MyDatabaseId;
+			launcherpid = AutoVacuumShmem->av_launcherpid;
+			signal_launcher = true;
+		}
+	}
+
+	LWLockRelease(AutovacuumLock);
+
+	if (signal_launcher && launcherpid != 0)
+		kill(launcherpid, SIGUSR2);
+
+	return result;
+}
+
 /*
  * AutoVacuumingActive
  *		Check GUC vars and report whether the autovacuum process should be
@@ -2930,6 +3491,9 @@ AutoVacuumShmemInit(void)
 		dlist_init(&AutoVacuumShmem->av_freeWorkers);
 		dlist_init(&AutoVacuumShmem->av_runningWorkers);
 		AutoVacuumShmem->av_startingWorker = NULL;
+		AutoVacuumShmem->av_handoffDatabase = InvalidOid;
+		memset(AutoVacuumShmem->av_workItems, 0,
+			   sizeof(AutoVacuumShmem->av_workItems));
 
 		worker = (WorkerInfo) ((char *) AutoVacuumShmem +
 							   MAXALIGN(sizeof(AutoVacuumShmemStruct)));
@@ -16,6 +16,7 @@
 
 #include "miscadmin.h"
 #include "libpq/pqsignal.h"
+#include "pgstat.h"
 #include "postmaster/bgworker_internals.h"
 #include "postmaster/postmaster.h"
 #include "storage/barrier.h"
@@ -973,8 +974,10 @@ WaitForBackgroundWorkerStartup(BackgroundWorkerHandle *handle, pid_t *pidp)
 			if (status != BGWH_NOT_YET_STARTED)
 				break;
 
+			pgstat_report_wait_start(WAIT_EVENT_BGWORKER_STARTUP);
 			rc = WaitLatch(MyLatch,
 						   WL_LATCH_SET | WL_POSTMASTER_DEATH, 0);
+			pgstat_report_wait_end();
 
 			if (rc & WL_POSTMASTER_DEATH)
 			{
@@ -1026,8 +1029,10 @@ WaitForBackgroundWorkerShutdown(BackgroundWorkerHandle *handle)
 			if (status == BGWH_STOPPED)
 				return status;
 
+			pgstat_report_wait_start(WAIT_EVENT_BGWORKER_SHUTDOWN);
 			rc = WaitLatch(&MyProc->procLatch,
 						   WL_LATCH_SET | WL_POSTMASTER_DEATH, 0);
+			pgstat_report_wait_end();
 
 			if (rc & WL_POSTMASTER_DEATH)
 				return BGWH_POSTMASTER_DIED;
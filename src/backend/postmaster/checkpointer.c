@@ -46,6 +46,7 @@
 #include "libpq/pqsignal.h"
 #include "miscadmin.h"
 #include "pgstat.h"
+#include "port/atomics.h"
 #include "postmaster/bgwriter.h"
 #include "replication/syncrep.h"
 #include "storage/bufmgr.h"
@@ -101,8 +102,15 @@
  * The requests array holds fsync requests sent by backends and not yet
  * absorbed by the checkpointer.
  *
- * Unlike the checkpoint fields, num_backend_writes, num_backend_fsync, and
- * the requests fields are protected by CheckpointerCommLock.
+ * fsync_cycle advances whenever the sync phase of a checkpoint starts, and
+ * whenever fsync requests are canceled.  Backends remember which segments
+ * they have already forwarded a request for in the current cycle, and skip
+ * sending duplicates; see register_dirty_segment in md.c.
+ *
+ * Unlike the checkpoint fields, num_backend_fsync and the requests fields
+ * are protected by CheckpointerCommLock.  num_backend_writes and fsync_cycle
+ * are accessed atomically, without the lock, because writes whose request
+ * is skipped as a duplicate are counted too.
  *----------
  */
 typedef struct
@@ -125,9 +133,11 @@ typedef struct
 
 	int			ckpt_flags;		/* checkpoint flags, as defined in xlog.h */
 
-	uint32		num_backend_writes;		/* counts user backend buffer writes */
+	pg_atomic_uint32 num_backend_writes;	/* counts user backend buffer writes */
 	uint32		num_backend_fsync;		/* counts user backend fsync calls */
 
+	pg_atomic_uint32 fsync_cycle;	/* see above */
+
 	int			num_requests;	/* current # of requests */
 	int			max_requests;	/* allocated array size */
 	CheckpointerRequest requests[FLEXIBLE_ARRAY_MEMBER];
@@ -921,6 +931,8 @@ CheckpointerShmemInit(void)
 		 */
 		MemSet(CheckpointerShmem, 0, size);
 		SpinLockInit(&CheckpointerShmem->ckpt_lck);
+		pg_atomic_init_u32(&CheckpointerShmem->num_backend_writes, 0);
+		pg_atomic_init_u32(&CheckpointerShmem->fsync_cycle, 0);
 		CheckpointerShmem->max_requests = NBuffers;
 	}
 }
@@ -1116,7 +1128,7 @@ ForwardFsyncRequest(RelFileNode rnode, ForkNumber forknum, BlockNumber segno)
 
 	/* Count all backend writes regardless of if they fit in the queue */
 	if (!AmBackgroundWriterProcess())
-		CheckpointerShmem->num_backend_writes++;
+		pg_atomic_fetch_add_u32(&CheckpointerShmem->num_backend_writes, 1);
 
 	/*
 	 * If the checkpointer isn't running or the request queue is full, the
@@ -1156,6 +1168,53 @@ ForwardFsyncRequest(RelFileNode rnode, ForkNumber forknum, BlockNumber segno)
 	return true;
 }
 
+/*
+ * GetFsyncRequestCycle
+ *		Return the current fsync request cycle
+ *
+ * A request forwarded in a cycle covers all later writes to the same
+ * segment made before the cycle advances.  To rely on that, a backend must
+ * read the cycle after its write, and before forwarding the request it
+ * remembers.
+ */
+uint32
+GetFsyncRequestCycle(void)
+{
+	if (CheckpointerShmem == NULL)
+		return 0;
+	return pg_atomic_read_u32(&CheckpointerShmem->fsync_cycle);
+}
+
+/*
+ * CountSkippedFsyncRequest
+ *		Count a backend write whose fsync request wasn't forwarded, because
+ *		one for the same segment already was in the current cycle
+ *
+ * This keeps the buffers_backend statistic the same as if every write had
+ * gone through ForwardFsyncRequest.
+ */
+void
+CountSkippedFsyncRequest(void)
+{
+	if (CheckpointerShmem != NULL && !AmBackgroundWriterProcess())
+		pg_atomic_fetch_add_u32(&CheckpointerShmem->num_backend_writes, 1);
+}
+
+/*
+ * AdvanceFsyncRequestCycle
+ *		Make backends forget which fsync requests they have already forwarded
+ *
+ * Called at the start of the sync phase of a checkpoint, after absorbing the
+ * requests it must include but before doing any fsync, and after forwarding
+ * a request that cancels earlier ones.
+ */
+void
+AdvanceFsyncRequestCycle(void)
+{
+	if (CheckpointerShmem != NULL)
+		pg_atomic_fetch_add_u32(&CheckpointerShmem->fsync_cycle, 1);
+}
+
 /*
  * CompactCheckpointerRequestQueue
  *		Remove duplicates from the request queue to avoid backend fsyncs.
@@ -1293,10 +1352,10 @@ AbsorbFsyncRequests(void)
 	LWLockAcquire(CheckpointerCommLock, LW_EXCLUSIVE);
 
 	/* Transfer stats counts into pending pgstats message */
-	BgWriterStats.m_buf_written_backend += CheckpointerShmem->num_backend_writes;
+	BgWriterStats.m_buf_written_backend +=
+		pg_atomic_exchange_u32(&CheckpointerShmem->num_backend_writes, 0);
 	BgWriterStats.m_buf_fsync_backend += CheckpointerShmem->num_backend_fsync;
 
-	CheckpointerShmem->num_backend_writes = 0;
 	CheckpointerShmem->num_backend_fsync = 0;
 
 	/*
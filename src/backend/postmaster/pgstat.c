@@ -2918,6 +2918,144 @@ pgstat_report_waiting(bool waiting)
 	beentry->st_waiting = waiting;
 }
 
+/* ----------
+ * pgstat_get_wait_event_type() -
+ *
+ *	Return the name of the class of a wait event reported by
+ *	pgstat_report_wait_start(), or NULL if the process isn't waiting.
+ * ----------
+ */
+const char *
+pgstat_get_wait_event_type(uint32 wait_event_info)
+{
+	switch (wait_event_info & 0xFF000000)
+	{
+		case 0:
+			return NULL;
+		case PG_WAIT_LWLOCK_NAMED:
+			return "LWLockNamed";
+		case PG_WAIT_LWLOCK_TRANCHE:
+			return "LWLockTranche";
+		case PG_WAIT_LOCK:
+			return "Lock";
+		case PG_WAIT_BUFFER_PIN:
+			return "BufferPin";
+		case PG_WAIT_ACTIVITY:
+			return "Activity";
+		case PG_WAIT_CLIENT:
+			return "Client";
+		case PG_WAIT_IPC:
+			return "IPC";
+		case PG_WAIT_TIMEOUT:
+			return "Timeout";
+		case PG_WAIT_IO:
+			return "IO";
+		default:
+			return "???";
+	}
+}
+
+/* ----------
+ * pgstat_get_wait_event() -
+ *
+ *	Return the name of a wait event reported by pgstat_report_wait_start(),
+ *	or NULL if the process isn't waiting.
+ * ----------
+ */
+const char *
+pgstat_get_wait_event(uint32 wait_event_info)
+{
+	uint32		classId = wait_event_info & 0xFF000000;
+	uint16		eventId = wait_event_info & 0x0000FFFF;
+
+	switch (classId)
+	{
+		case 0:
+			return NULL;
+		case PG_WAIT_LWLOCK_NAMED:
+		case PG_WAIT_LWLOCK_TRANCHE:
+			return GetLWLockIdentifier(classId, eventId);
+		case PG_WAIT_LOCK:
+			if (eventId <= LOCKTAG_LAST_TYPE)
+				return LockTagTypeNames[eventId];
+			break;
+		case PG_WAIT_BUFFER_PIN:
+			return "BufferPin";
+		default:
+			break;
+	}
+
+	switch (wait_event_info)
+	{
+		case WAIT_EVENT_WAL_SENDER_MAIN:
+			return "WalSenderMain";
+		case WAIT_EVENT_CLIENT_READ:
+			return "ClientRead";
+		case WAIT_EVENT_CLIENT_WRITE:
+			return "ClientWrite";
+		case WAIT_EVENT_SSL_OPEN_SERVER:
+			return "SSLOpenServer";
+		case WAIT_EVENT_WAL_SENDER_WAIT_WAL:
+			return "WalSenderWaitForWAL";
+		case WAIT_EVENT_WAL_SENDER_WRITE_DATA:
+			return "WalSenderWriteData";
+		case WAIT_EVENT_BGWORKER_SHUTDOWN:
+			return "BgWorkerShutdown";
+		case WAIT_EVENT_BGWORKER_STARTUP:
+			return "BgWorkerStartup";
+		case WAIT_EVENT_BITMAP_BUILD:
+			return "BitmapBuild";
+		case WAIT_EVENT_BTREE_PAGE:
+			return "BtreePage";
+		case WAIT_EVENT_EXECUTE_GATHER:
+			return "ExecuteGather";
+		case WAIT_EVENT_GIN_BUILD_WORKERS:
+			return "GinBuildWorkers";
+		case WAIT_EVENT_HASH_BUILD_WORKERS:
+			return "HashBuildWorkers";
+		case WAIT_EVENT_MQ_INTERNAL:
+			return "MessageQueueInternal";
+		case WAIT_EVENT_MQ_PUT_MESSAGE:
+			return "MessageQueuePutMessage";
+		case WAIT_EVENT_MQ_RECEIVE:
+			return "MessageQueueReceive";
+		case WAIT_EVENT_MQ_SEND:
+			return "MessageQueueSend";
+		case WAIT_EVENT_PARALLEL_FINISH:
+			return "ParallelFinish";
+		case WAIT_EVENT_SYNC_REP:
+			return "SyncRep";
+		case WAIT_EVENT_BASE_BACKUP_THROTTLE:
+			return "BaseBackupThrottle";
+		case WAIT_EVENT_PG_SLEEP:
+			return "PgSleep";
+		case WAIT_EVENT_BUFFILE_READ:
+			return "BufFileRead";
+		case WAIT_EVENT_BUFFILE_WRITE:
+			return "BufFileWrite";
+		case WAIT_EVENT_DATA_FILE_EXTEND:
+			return "DataFileExtend";
+		case WAIT_EVENT_DATA_FILE_IMMEDIATE_SYNC:
+			return "DataFileImmediateSync";
+		case WAIT_EVENT_DATA_FILE_READ:
+			return "DataFileRead";
+		case WAIT_EVENT_DATA_FILE_SYNC:
+			return "DataFileSync";
+		case WAIT_EVENT_DATA_FILE_TRUNCATE:
+			return "DataFileTruncate";
+		case WAIT_EVENT_DATA_FILE_WRITE:
+			return "DataFileWrite";
+		case WAIT_EVENT_WAL_READ:
+			return "WALRead";
+		case WAIT_EVENT_WAL_SYNC:
+			return "WALSync";
+		case WAIT_EVENT_WAL_WRITE:
+			return "WALWrite";
+	}
+
+	return "unknown wait event";
+}
+
 
 /* ----------
  * pgstat_read_current_status() -
@@ -3693,6 +3831,8 @@ pgstat_get_tab_entry(PgStat_StatDBEntry *dbentry, Oid tableoid, bool create)
 		result->changes_since_analyze = 0;
 		result->blocks_fetched = 0;
 		result->blocks_hit = 0;
+		result->ext_lock_waits = 0;
+		result->prunes_deferred = 0;
 		result->vacuum_timestamp = 0;
 		result->vacuum_count = 0;
 		result->autovac_vacuum_timestamp = 0;
@@ -4794,6 +4934,8 @@ pgstat_recv_tabstat(PgStat_MsgTabstat *msg, int len)
 			tabentry->changes_since_analyze = tabmsg->t_counts.t_changed_tuples;
 			tabentry->blocks_fetched = tabmsg->t_counts.t_blocks_fetched;
 			tabentry->blocks_hit = tabmsg->t_counts.t_blocks_hit;
+			tabentry->ext_lock_waits = tabmsg->t_counts.t_ext_lock_waits;
+			tabentry->prunes_deferred = tabmsg->t_counts.t_prunes_deferred;
 
 			tabentry->vacuum_timestamp = 0;
 			tabentry->vacuum_count = 0;
@@ -4827,6 +4969,8 @@ pgstat_recv_tabstat(PgStat_MsgTabstat *msg, int len)
 			tabentry->changes_since_analyze += tabmsg->t_counts.t_changed_tuples;
 			tabentry->blocks_fetched += tabmsg->t_counts.t_blocks_fetched;
 			tabentry->blocks_hit += tabmsg->t_counts.t_blocks_hit;
+			tabentry->ext_lock_waits += tabmsg->t_counts.t_ext_lock_waits;
+			tabentry->prunes_deferred += tabmsg->t_counts.t_prunes_deferred;
 		}
 
 		/* Clamp n_live_tuples in case of negative delta_live_tuples */
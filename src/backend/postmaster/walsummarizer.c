@@ -0,0 +1,1040 @@
+/*-------------------------------------------------------------------------
+ *
+ * walsummarizer.c
+ *
+ * The WAL summarizer reads the WAL as it is flushed, and writes the numbers
+ * of the blocks modified by each stretch of it to a summary file in
+ * pg_xlog/summaries.  An incremental base backup uses the summaries covering
+ * the WAL since the previous backup to find the blocks to send, instead of
+ * reading every relation file and comparing page LSNs; see basebackup.c.
+ *
+ * The summarizer is started by the postmaster during normal operation if
+ * summarize_wal is on, and exits when it is turned off.  Normal termination
+ * is by SIGTERM, which makes it write out what it has summarized so far and
+ * exit(0).  Emergency termination is by SIGQUIT; like any backend, the
+ * summarizer will simply abort and exit on SIGQUIT.
+ *
+ * Summaries are only an optimization.  If the WAL the summarizer needs was
+ * removed before it could read it, it starts over from the latest redo
+ * point, leaving a gap in the summaries; incremental backups whose WAL
+ * isn't covered fall back to reading all the relation files.
+ *
+ * The format of the summary files is described in postmaster/walsummary.h.
+ *
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ *
+ *
+ * IDENTIFICATION
+ *	  src/backend/postmaster/walsummarizer.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "access/xlog.h"
+#include "access/xlog_internal.h"
+#include "access/xlogreader.h"
+#include "catalog/storage_xlog.h"
+#include "commands/dbcommands_xlog.h"
+#include "libpq/pqsignal.h"
+#include "miscadmin.h"
+#include "port/pg_crc32c.h"
+#include "postmaster/walsummarizer.h"
+#include "replication/logicalfuncs.h"
+#include "storage/fd.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/lwlock.h"
+#include "storage/proc.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"
+#include "utils/resowner.h"
+#include "utils/timestamp.h"
+
+
+/*
+ * GUC parameters
+ */
+bool		summarize_wal = false;
+int			wal_summary_keep_time = 10 * 24 * 60;		/* minutes */
+
+/* A summary is written at least every SUMMARY_MAX_WAL bytes of WAL... */
+#define SUMMARY_MAX_WAL			(16 * XLogSegSize)
+/* ... and, once caught up, when the last one is this old (in ms) */
+#define SUMMARY_FLUSH_INTERVAL	10000
+/* How long to sleep when caught up (in ms) */
+#define SUMMARIZER_NAPTIME		500
+/* Records to summarize between checks for interrupts */
+#define RECORDS_PER_CYCLE		1000
+
+/* How long LoadWalSummaries waits for the summarizer to catch up (in ms) */
+#define SUMMARY_WAIT_TIMEOUT	60000
+
+/* A summary file found in WAL_SUMMARY_DIR */
+typedef struct WalSummaryFile
+{
+	XLogRecPtr	startptr;
+	XLogRecPtr	endptr;
+} WalSummaryFile;
+
+/*
+ * Flags set by interrupt handlers for later service in the main loop.
+ */
+static volatile sig_atomic_t got_SIGHUP = false;
+static volatile sig_atomic_t shutdown_requested = false;
+
+/*
+ * State of the summarizer.  The blocks modified by the records between
+ * summary_start and next_lsn are collected in 'pending', until written to a
+ * summary file.
+ */
+static XLogReaderState *reader = NULL;
+static BlockRefTable *pending = NULL;
+static XLogRecPtr summary_start = InvalidXLogRecPtr;
+static XLogRecPtr next_lsn = InvalidXLogRecPtr;
+static bool reader_positioned = false;
+static TimestampTz last_flush_time = 0;
+
+/* Signal handlers */
+static void summarizer_quickdie(SIGNAL_ARGS);
+static void SummarizerSigHupHandler(SIGNAL_ARGS);
+static void SummarizerShutdownHandler(SIGNAL_ARGS);
+static void summarizer_sigusr1_handler(SIGNAL_ARGS);
+
+static void StartSummarizing(void);
+static bool SummarizeRecords(void);
+static void SummarizeRecord(XLogReaderState *record);
+static void WriteSummary(void);
+static void RemoveOldSummaries(void);
+static int summarizer_read_page(XLogReaderState *state,
+					 XLogRecPtr targetPagePtr, int reqLen,
+					 XLogRecPtr targetRecPtr, char *cur_page,
+					 TimeLineID *pageTLI);
+static WalSummaryFile *ListWalSummaries(int *nfiles);
+static bool ReadWalSummary(WalSummaryFile *file, BlockRefTable *brtab);
+static void summary_write(int fd, const char *path, const void *data,
+			  size_t len, pg_crc32c *crc);
+static int	blocknum_cmp(const void *a, const void *b);
+static int	summary_file_cmp(const void *a, const void *b);
+static void SortBlockRefEntry(BlockRefEntry *entry);
+
+/*
+ * Main entry point for the WAL summarizer process
+ *
+ * This is invoked from AuxiliaryProcessMain, which has already created the
+ * basic execution environment, but not enabled signals yet.
+ */
+void
+WalSummarizerMain(void)
+{
+	sigjmp_buf	local_sigjmp_buf;
+	MemoryContext summarizer_context;
+
+	/*
+	 * Properly accept or ignore signals the postmaster might send us
+	 */
+	pqsignal(SIGHUP, SummarizerSigHupHandler);	/* set flag to read config
+												 * file */
+	pqsignal(SIGINT, SummarizerShutdownHandler);		/* request shutdown */
+	pqsignal(SIGTERM, SummarizerShutdownHandler);	/* request shutdown */
+	pqsignal(SIGQUIT, summarizer_quickdie);		/* hard crash time */
+	pqsignal(SIGALRM, SIG_IGN);
+	pqsignal(SIGPIPE, SIG_IGN);
+	pqsignal(SIGUSR1, summarizer_sigusr1_handler);
+	pqsignal(SIGUSR2, SIG_IGN); /* not used */
+
+	/*
+	 * Reset some signals that are accepted by postmaster but not here
+	 */
+	pqsignal(SIGCHLD, SIG_DFL);
+	pqsignal(SIGTTIN, SIG_DFL);
+	pqsignal(SIGTTOU, SIG_DFL);
+	pqsignal(SIGCONT, SIG_DFL);
+	pqsignal(SIGWINCH, SIG_DFL);
+
+	/* We allow SIGQUIT (quickdie) at all times */
+	sigdelset(&BlockSig, SIGQUIT);
+
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, "Wal Summarizer");
+
+	summarizer_context = AllocSetContextCreate(TopMemoryContext,
+											   "Wal Summarizer",
+											   ALLOCSET_DEFAULT_MINSIZE,
+											   ALLOCSET_DEFAULT_INITSIZE,
+											   ALLOCSET_DEFAULT_MAXSIZE);
+	MemoryContextSwitchTo(summarizer_context);
+
+	/*
+	 * If an exception is encountered, processing resumes here.  We throw
+	 * away what wasn't written out yet, and start over from the end of the
+	 * last summary.
+	 */
+	if (sigsetjmp(local_sigjmp_buf, 1) != 0)
+	{
+		/* Since not using PG_TRY, must reset error stack by hand */
+		error_context_stack = NULL;
+
+		/* Prevent interrupts while cleaning up */
+		HOLD_INTERRUPTS();
+
+		/* Report the error to the server log */
+		EmitErrorReport();
+
+		LWLockReleaseAll();
+		AtEOXact_Files();
+
+		MemoryContextSwitchTo(summarizer_context);
+		FlushErrorState();
+
+		/* Flush any leaked data in the top-level context */
+		MemoryContextResetAndDeleteChildren(summarizer_context);
+		reader = NULL;
+		pending = NULL;
+
+		/* Now we can allow interrupts again */
+		RESUME_INTERRUPTS();
+
+		/*
+		 * Sleep at least 1 second after any error, so as not to fill the
+		 * logs if it is repeated.
+		 */
+		pg_usleep(1000000L);
+	}
+
+	/* We can now handle ereport(ERROR) */
+	PG_exception_stack = &local_sigjmp_buf;
+
+	/*
+	 * Unblock signals (they were blocked when the postmaster forked us)
+	 */
+	PG_SETMASK(&UnBlockSig);
+
+	StartSummarizing();
+
+	/*
+	 * Loop forever
+	 */
+	for (;;)
+	{
+		XLogSegNo	segno;
+		bool		caught_up;
+
+		/* Clear any already-pending wakeups */
+		ResetLatch(MyLatch);
+
+		/*
+		 * Process any requests or signals received recently.
+		 */
+		if (got_SIGHUP)
+		{
+			got_SIGHUP = false;
+			ProcessConfigFile(PGC_SIGHUP);
+		}
+		if (shutdown_requested || !summarize_wal)
+		{
+			/* Normal exit from the summarizer is here */
+			if (next_lsn > summary_start)
+				WriteSummary();
+			proc_exit(0);		/* done */
+		}
+
+		/*
+		 * If the WAL we need is gone, skip to the latest redo point.
+		 */
+		XLByteToSeg(next_lsn, segno);
+		if (segno <= XLogGetLastRemovedSegno())
+		{
+			XLogRecPtr	redoptr = GetRedoRecPtr();
+
+			ereport(LOG,
+					(errmsg("WAL summarization skipping from %X/%X to %X/%X because the WAL was removed",
+							(uint32) (next_lsn >> 32), (uint32) next_lsn,
+							(uint32) (redoptr >> 32), (uint32) redoptr)));
+			MemoryContextDelete(pending->cxt);
+			pending = CreateBlockRefTable();
+			summary_start = next_lsn = redoptr;
+			reader_positioned = false;
+		}
+
+		caught_up = SummarizeRecords();
+
+		if (!caught_up)
+			continue;
+
+		if (next_lsn > summary_start &&
+			TimestampDifferenceExceeds(last_flush_time, GetCurrentTimestamp(),
+									   SUMMARY_FLUSH_INTERVAL))
+			WriteSummary();
+
+		/*
+		 * Sleep until we are signaled or it's time to look for new WAL.
+		 */
+		if (WaitLatch(MyLatch,
+					  WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+					  SUMMARIZER_NAPTIME) & WL_POSTMASTER_DEATH)
+			exit(1);
+	}
+}
+
+/*
+ * Set up the reader, and find where to start: at the end of the latest
+ * summary, or at the latest redo point if there are none.
+ */
+static void
+StartSummarizing(void)
+{
+	WalSummaryFile *files;
+	int			nfiles;
+	int			i;
+
+	if (mkdir(WAL_SUMMARY_DIR, S_IRWXU) < 0 && errno != EEXIST)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not create directory \"%s\": %m",
+						WAL_SUMMARY_DIR)));
+
+	reader = XLogReaderAllocate(summarizer_read_page, NULL);
+	if (reader == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OUT_OF_MEMORY),
+				 errmsg("out of memory")));
+	pending = CreateBlockRefTable();
+
+	next_lsn = InvalidXLogRecPtr;
+	files = ListWalSummaries(&nfiles);
+	for (i = 0; i < nfiles; i++)
+		next_lsn = Max(next_lsn, files[i].endptr);
+	pfree(files);
+
+	if (next_lsn == InvalidXLogRecPtr)
+		next_lsn = GetRedoRecPtr();
+	summary_start = next_lsn;
+	reader_positioned = false;
+	last_flush_time = GetCurrentTimestamp();
+}
+
+/*
+ * Summarize the flushed WAL following next_lsn, up to RECORDS_PER_CYCLE
+ * records.  Returns true if all the flushed WAL was summarized.
+ */
+static bool
+SummarizeRecords(void)
+{
+	int			i;
+
+	for (i = 0; i < RECORDS_PER_CYCLE; i++)
+	{
+		XLogRecord *record;
+		char	   *errormsg;
+
+		record = XLogReadRecord(reader,
+						reader_positioned ? InvalidXLogRecPtr : next_lsn,
+								&errormsg);
+		if (record == NULL)
+		{
+			reader_positioned = false;
+			if (errormsg)
+				ereport(ERROR,
+						(errmsg("could not read WAL record at %X/%X: %s",
+								(uint32) (next_lsn >> 32), (uint32) next_lsn,
+								errormsg)));
+			/* not flushed yet */
+			return true;
+		}
+		reader_positioned = true;
+
+		SummarizeRecord(reader);
+		next_lsn = reader->EndRecPtr;
+
+		if (next_lsn - summary_start >= SUMMARY_MAX_WAL)
+			WriteSummary();
+	}
+
+	return false;
+}
+
+/*
+ * Add the blocks modified by a WAL record to the pending summary.
+ */
+static void
+SummarizeRecord(XLogReaderState *record)
+{
+	uint8		rmid = XLogRecGetRmid(record);
+	uint8		info = XLogRecGetInfo(record) & ~XLR_INFO_MASK;
+	int			block_id;
+
+	for (block_id = 0; block_id <= record->max_block_id; block_id++)
+	{
+		RelFileNode rnode;
+		ForkNumber	forknum;
+		BlockNumber blkno;
+
+		if (!XLogRecGetBlockTag(record, block_id, &rnode, &forknum, &blkno))
+			continue;
+		BlockRefTableMarkBlock(pending, &rnode, forknum, blkno);
+	}
+
+	/*
+	 * Creating or truncating a relation fork changes blocks that no record
+	 * refers to, and so does copying a database.
+	 */
+	if (rmid == RM_SMGR_ID && info == XLOG_SMGR_CREATE)
+	{
+		xl_smgr_create *xlrec = (xl_smgr_create *) XLogRecGetData(record);
+
+		BlockRefTableSetLimit(pending, &xlrec->rnode, xlrec->forkNum, 0);
+	}
+	else if (rmid == RM_SMGR_ID && info == XLOG_SMGR_TRUNCATE)
+	{
+		xl_smgr_truncate *xlrec = (xl_smgr_truncate *) XLogRecGetData(record);
+
+		BlockRefTableSetLimit(pending, &xlrec->rnode, MAIN_FORKNUM,
+							  xlrec->blkno);
+	}
+	else if (rmid == RM_DBASE_ID && info == XLOG_DBASE_CREATE)
+	{
+		xl_dbase_create_rec *xlrec =
+		(xl_dbase_create_rec *) XLogRecGetData(record);
+		RelFileNode rnode;
+
+		rnode.spcNode = xlrec->tablespace_id;
+		rnode.dbNode = xlrec->db_id;
+		rnode.relNode = InvalidOid;
+		BlockRefTableSetLimit(pending, &rnode, MAIN_FORKNUM, 0);
+	}
+}
+
+/*
+ * Write the pending summary to a file, and start a new one.
+ */
+static void
+WriteSummary(void)
+{
+	char		path[MAXPGPATH];
+	char		tmppath[MAXPGPATH];
+	WalSummaryFileHeader hdr;
+	HASH_SEQ_STATUS status;
+	BlockRefEntry *entry;
+	pg_crc32c	crc;
+	int			fd;
+
+	snprintf(path, MAXPGPATH, WAL_SUMMARY_DIR "/%08X%08X%08X%08X.summary",
+			 (uint32) (summary_start >> 32), (uint32) summary_start,
+			 (uint32) (next_lsn >> 32), (uint32) next_lsn);
+	snprintf(tmppath, MAXPGPATH,
+			 WAL_SUMMARY_DIR "/%08X%08X%08X%08X.summary.tmp",
+			 (uint32) (summary_start >> 32), (uint32) summary_start,
+			 (uint32) (next_lsn >> 32), (uint32) next_lsn);
+
+	fd = OpenTransientFile(tmppath, O_RDWR | O_CREAT | O_TRUNC | PG_BINARY,
+						   S_IRUSR | S_IWUSR);
+	if (fd < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not create file \"%s\": %m", tmppath)));
+
+	INIT_CRC32C(crc);
+
+	MemSet(&hdr, 0, sizeof(hdr));
+	hdr.magic = WAL_SUMMARY_MAGIC;
+	hdr.version = WAL_SUMMARY_VERSION;
+	hdr.startptr = summary_start;
+	hdr.endptr = next_lsn;
+	hdr.nentries = hash_get_num_entries(pending->hash);
+	summary_write(fd, tmppath, &hdr, sizeof(hdr), &crc);
+
+	hash_seq_init(&status, pending->hash);
+	while ((entry = (BlockRefEntry *) hash_seq_search(&status)) != NULL)
+	{
+		WalSummaryEntry sentry;
+
+		SortBlockRefEntry(entry);
+
+		MemSet(&sentry, 0, sizeof(sentry));
+		sentry.rnode = entry->key.rnode;
+		sentry.forknum = entry->key.forknum;
+		sentry.limit = entry->limit;
+		sentry.nblocks = entry->nblocks;
+		summary_write(fd, tmppath, &sentry, sizeof(sentry), &crc);
+		summary_write(fd, tmppath, entry->blocks,
+					  entry->nblocks * sizeof(BlockNumber), &crc);
+	}
+
+	FIN_CRC32C(crc);
+	if (write(fd, &crc, sizeof(crc)) != sizeof(crc))
+	{
+		/* if write didn't set errno, assume problem is no disk space */
+		if (errno == 0)
+			errno = ENOSPC;
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write file \"%s\": %m", tmppath)));
+	}
+
+	if (pg_fsync(fd) != 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not fsync file \"%s\": %m", tmppath)));
+	if (CloseTransientFile(fd))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not close file \"%s\": %m", tmppath)));
+
+	if (rename(tmppath, path) < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not rename file \"%s\" to \"%s\": %m",
+						tmppath, path)));
+
+	elog(DEBUG1, "wrote WAL summary \"%s\"", path);
+
+	MemoryContextDelete(pending->cxt);
+	pending = CreateBlockRefTable();
+	summary_start = next_lsn;
+	last_flush_time = GetCurrentTimestamp();
+
+	RemoveOldSummaries();
+}
+
+/*
+ * Write to a summary file, and add the data to its CRC.
+ */
+static void
+summary_write(int fd, const char *path, const void *data, size_t len,
+			  pg_crc32c *crc)
+{
+	errno = 0;
+	if (write(fd, data, len) != len)
+	{
+		/* if write didn't set errno, assume problem is no disk space */
+		if (errno == 0)
+			errno = ENOSPC;
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write file \"%s\": %m", path)));
+	}
+	COMP_CRC32C(*crc, data, len);
+}
+
+/*
+ * Remove the summaries older than wal_summary_keep_time, and any temporary
+ * files left behind by a crash.
+ */
+static void
+RemoveOldSummaries(void)
+{
+	DIR		   *dir;
+	struct dirent *de;
+	time_t		cutoff = time(NULL) - (time_t) wal_summary_keep_time * 60;
+
+	dir = AllocateDir(WAL_SUMMARY_DIR);
+	while ((de = ReadDir(dir, WAL_SUMMARY_DIR)) != NULL)
+	{
+		char		path[MAXPGPATH];
+		struct stat statbuf;
+		size_t		len = strlen(de->d_name);
+		bool		istmp;
+		bool		issummary;
+
+		istmp = (len > 4 && strcmp(de->d_name + len - 4, ".tmp") == 0);
+		issummary = (len > 8 && strcmp(de->d_name + len - 8, ".summary") == 0);
+		if (!istmp && !(issummary && wal_summary_keep_time > 0))
+			continue;
+
+		snprintf(path, MAXPGPATH, WAL_SUMMARY_DIR "/%s", de->d_name);
+		if (lstat(path, &statbuf) != 0)
+			continue;
+		if (statbuf.st_mtime >= cutoff)
+			continue;
+
+		elog(DEBUG2, "removing WAL summary \"%s\"", path);
+		if (unlink(path) != 0)
+			ereport(LOG,
+					(errcode_for_file_access(),
+					 errmsg("could not remove file \"%s\": %m", path)));
+	}
+	FreeDir(dir);
+}
+
+/*
+ * read_page callback for the summarizer's xlogreader.  Only flushed WAL is
+ * read; if it's not there yet, we come back later rather than wait here.
+ */
+static int
+summarizer_read_page(XLogReaderState *state, XLogRecPtr targetPagePtr,
+					 int reqLen, XLogRecPtr targetRecPtr, char *cur_page,
+					 TimeLineID *pageTLI)
+{
+	if (targetPagePtr + reqLen > GetFlushRecPtr())
+		return -1;
+
+	return logical_read_local_xlog_page(state, targetPagePtr, reqLen,
+										targetRecPtr, cur_page, pageTLI);
+}
+
+
+/* --------------------------------
+ *		block reference tables
+ * --------------------------------
+ */
+
+/*
+ * Create an empty BlockRefTable, in a memory context of its own under
+ * CurrentMemoryContext.  Delete the context to free it.
+ */
+BlockRefTable *
+CreateBlockRefTable(void)
+{
+	MemoryContext cxt;
+	BlockRefTable *brtab;
+	HASHCTL		ctl;
+
+	cxt = AllocSetContextCreate(CurrentMemoryContext,
+								"block reference table",
+								ALLOCSET_DEFAULT_MINSIZE,
+								ALLOCSET_DEFAULT_INITSIZE,
+								ALLOCSET_DEFAULT_MAXSIZE);
+	brtab = MemoryContextAlloc(cxt, sizeof(BlockRefTable));
+	brtab->cxt = cxt;
+
+	MemSet(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(BlockRefKey);
+	ctl.entrysize = sizeof(BlockRefEntry);
+	ctl.hcxt = cxt;
+	brtab->hash = hash_create("block reference table", 1024, &ctl,
+							  HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	return brtab;
+}
+
+static BlockRefEntry *
+BlockRefTableGetEntry(BlockRefTable *brtab, RelFileNode *rnode,
+					  ForkNumber forknum)
+{
+	BlockRefKey key;
+	BlockRefEntry *entry;
+	bool		found;
+
+	MemSet(&key, 0, sizeof(key));
+	key.rnode = *rnode;
+	key.forknum = forknum;
+
+	entry = (BlockRefEntry *) hash_search(brtab->hash, &key, HASH_ENTER,
+										  &found);
+	if (!found)
+	{
+		entry->limit = InvalidBlockNumber;
+		entry->nblocks = 0;
+		entry->maxblocks = 16;
+		entry->sorted = true;
+		entry->blocks = MemoryContextAlloc(brtab->cxt,
+									   entry->maxblocks * sizeof(BlockNumber));
+	}
+	return entry;
+}
+
+/*
+ * Record that a block was modified.
+ */
+void
+BlockRefTableMarkBlock(BlockRefTable *brtab, RelFileNode *rnode,
+					   ForkNumber forknum, BlockNumber blkno)
+{
+	BlockRefEntry *entry = BlockRefTableGetEntry(brtab, rnode, forknum);
+
+	/* the same block is often modified by consecutive records */
+	if (entry->nblocks > 0 && entry->blocks[entry->nblocks - 1] == blkno)
+		return;
+
+	if (entry->nblocks >= entry->maxblocks)
+	{
+		/* make room by removing duplicates, if that frees up enough */
+		SortBlockRefEntry(entry);
+		if (entry->nblocks >= entry->maxblocks / 2)
+		{
+			entry->maxblocks *= 2;
+			entry->blocks = repalloc(entry->blocks,
+									 entry->maxblocks * sizeof(BlockNumber));
+		}
+	}
+
+	if (entry->nblocks > 0 && entry->blocks[entry->nblocks - 1] > blkno)
+		entry->sorted = false;
+	entry->blocks[entry->nblocks++] = blkno;
+}
+
+/*
+ * Record that all blocks of a relation fork starting at 'limit' were
+ * modified.
+ */
+void
+BlockRefTableSetLimit(BlockRefTable *brtab, RelFileNode *rnode,
+					  ForkNumber forknum, BlockNumber limit)
+{
+	BlockRefEntry *entry = BlockRefTableGetEntry(brtab, rnode, forknum);
+
+	entry->limit = Min(entry->limit, limit);
+}
+
+/*
+ * Look up the modified blocks of a relation fork, with the block numbers
+ * sorted and without duplicates.  Returns NULL if none.
+ */
+BlockRefEntry *
+BlockRefTableLookup(BlockRefTable *brtab, RelFileNode *rnode,
+					ForkNumber forknum)
+{
+	BlockRefKey key;
+	BlockRefEntry *entry;
+
+	MemSet(&key, 0, sizeof(key));
+	key.rnode = *rnode;
+	key.forknum = forknum;
+
+	entry = (BlockRefEntry *) hash_search(brtab->hash, &key, HASH_FIND,
+										  NULL);
+	if (entry)
+		SortBlockRefEntry(entry);
+	return entry;
+}
+
+static void
+SortBlockRefEntry(BlockRefEntry *entry)
+{
+	uint32		i,
+				n;
+
+	if (entry->sorted || entry->nblocks < 2)
+	{
+		entry->sorted = true;
+		return;
+	}
+
+	qsort(entry->blocks, entry->nblocks, sizeof(BlockNumber), blocknum_cmp);
+	for (i = 1, n = 1; i < entry->nblocks; i++)
+	{
+		if (entry->blocks[i] != entry->blocks[n - 1])
+			entry->blocks[n++] = entry->blocks[i];
+	}
+	entry->nblocks = n;
+	entry->sorted = true;
+}
+
+static int
+blocknum_cmp(const void *a, const void *b)
+{
+	BlockNumber ba = *(const BlockNumber *) a;
+	BlockNumber bb = *(const BlockNumber *) b;
+
+	if (ba < bb)
+		return -1;
+	if (ba > bb)
+		return 1;
+	return 0;
+}
+
+
+/* --------------------------------
+ *		reading summaries
+ * --------------------------------
+ */
+
+/*
+ * Load the blocks modified by the WAL between startptr and endptr, from the
+ * summaries covering it.
+ *
+ * If the summarizer hasn't reached endptr yet, wait for it for a while.
+ * Returns NULL if the summaries don't cover the whole range, because the
+ * summarizer wasn't running or skipped some WAL, or if one can't be read.
+ */
+BlockRefTable *
+LoadWalSummaries(XLogRecPtr startptr, XLogRecPtr endptr)
+{
+	BlockRefTable *brtab;
+	WalSummaryFile *files;
+	int			nfiles;
+	int			nchain;
+	int			waited = 0;
+	int			i;
+
+	for (;;)
+	{
+		XLogRecPtr	covered = startptr;
+
+		/*
+		 * Chain the summaries that cover the WAL following startptr,
+		 * moving the selected ones to the front of the array.
+		 */
+		files = ListWalSummaries(&nfiles);
+		nchain = 0;
+		for (i = 0; i < nfiles && covered < endptr; i++)
+		{
+			if (files[i].startptr <= covered && files[i].endptr > covered)
+			{
+				covered = files[i].endptr;
+				files[nchain++] = files[i];
+			}
+		}
+
+		if (covered >= endptr)
+			break;
+
+		pfree(files);
+
+		/* Nothing covers startptr, it's not going to get any better */
+		if (nchain == 0 || !summarize_wal || waited >= SUMMARY_WAIT_TIMEOUT)
+			return NULL;
+
+		CHECK_FOR_INTERRUPTS();
+		pg_usleep(100000L);
+		waited += 100;
+	}
+
+	brtab = CreateBlockRefTable();
+	for (i = 0; i < nchain; i++)
+	{
+		if (!ReadWalSummary(&files[i], brtab))
+		{
+			MemoryContextDelete(brtab->cxt);
+			brtab = NULL;
+			break;
+		}
+	}
+	pfree(files);
+
+	return brtab;
+}
+
+/*
+ * Return the summary files present, sorted by start position.
+ */
+static WalSummaryFile *
+ListWalSummaries(int *nfiles)
+{
+	DIR		   *dir;
+	struct dirent *de;
+	WalSummaryFile *files;
+	int			maxfiles = 64;
+
+	files = palloc(maxfiles * sizeof(WalSummaryFile));
+	*nfiles = 0;
+
+	dir = AllocateDir(WAL_SUMMARY_DIR);
+	if (dir == NULL && errno == ENOENT)
+		return files;
+	while ((de = ReadDir(dir, WAL_SUMMARY_DIR)) != NULL)
+	{
+		uint32		starthi,
+					startlo,
+					endhi,
+					endlo;
+		char		suffix;
+
+		if (strlen(de->d_name) != 32 + strlen(".summary") ||
+			strcmp(de->d_name + 32, ".summary") != 0 ||
+			sscanf(de->d_name, "%08X%08X%08X%08X%c", &starthi, &startlo,
+				   &endhi, &endlo, &suffix) != 5)
+			continue;
+
+		if (*nfiles >= maxfiles)
+		{
+			maxfiles *= 2;
+			files = repalloc(files, maxfiles * sizeof(WalSummaryFile));
+		}
+		files[*nfiles].startptr = ((uint64) starthi) << 32 | startlo;
+		files[*nfiles].endptr = ((uint64) endhi) << 32 | endlo;
+		(*nfiles)++;
+	}
+	FreeDir(dir);
+
+	qsort(files, *nfiles, sizeof(WalSummaryFile), summary_file_cmp);
+
+	return files;
+}
+
+static int
+summary_file_cmp(const void *a, const void *b)
+{
+	const WalSummaryFile *fa = (const WalSummaryFile *) a;
+	const WalSummaryFile *fb = (const WalSummaryFile *) b;
+
+	if (fa->startptr != fb->startptr)
+		return (fa->startptr < fb->startptr) ? -1 : 1;
+	if (fa->endptr != fb->endptr)
+		return (fa->endptr < fb->endptr) ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Add the contents of a summary file to a BlockRefTable.  Returns false,
+ * with a LOG message, if the file is missing or invalid.
+ */
+static bool
+ReadWalSummary(WalSummaryFile *file, BlockRefTable *brtab)
+{
+	char		path[MAXPGPATH];
+	int			fd;
+	struct stat statbuf;
+	char	   *buf;
+	char	   *p;
+	char	   *end;
+	WalSummaryFileHeader hdr;
+	pg_crc32c	crc;
+	pg_crc32c	filecrc;
+	uint32		i;
+
+	snprintf(path, MAXPGPATH, WAL_SUMMARY_DIR "/%08X%08X%08X%08X.summary",
+			 (uint32) (file->startptr >> 32), (uint32) file->startptr,
+			 (uint32) (file->endptr >> 32), (uint32) file->endptr);
+
+	fd = OpenTransientFile(path, O_RDONLY | PG_BINARY, 0);
+	if (fd < 0)
+	{
+		ereport(LOG,
+				(errcode_for_file_access(),
+				 errmsg("could not open file \"%s\": %m", path)));
+		return false;
+	}
+	if (fstat(fd, &statbuf) != 0)
+	{
+		ereport(LOG,
+				(errcode_for_file_access(),
+				 errmsg("could not stat file \"%s\": %m", path)));
+		CloseTransientFile(fd);
+		return false;
+	}
+	if (statbuf.st_size < sizeof(WalSummaryFileHeader) + sizeof(pg_crc32c))
+	{
+		ereport(LOG,
+				(errmsg("invalid WAL summary file \"%s\"", path)));
+		CloseTransientFile(fd);
+		return false;
+	}
+
+	buf = palloc(statbuf.st_size);
+	if (read(fd, buf, statbuf.st_size) != statbuf.st_size)
+	{
+		ereport(LOG,
+				(errcode_for_file_access(),
+				 errmsg("could not read file \"%s\": %m", path)));
+		CloseTransientFile(fd);
+		pfree(buf);
+		return false;
+	}
+	CloseTransientFile(fd);
+
+	end = buf + statbuf.st_size - sizeof(pg_crc32c);
+	INIT_CRC32C(crc);
+	COMP_CRC32C(crc, buf, end - buf);
+	FIN_CRC32C(crc);
+	memcpy(&filecrc, end, sizeof(pg_crc32c));
+	memcpy(&hdr, buf, sizeof(hdr));
+	if (!EQ_CRC32C(crc, filecrc) ||
+		hdr.magic != WAL_SUMMARY_MAGIC || hdr.version != WAL_SUMMARY_VERSION)
+	{
+		ereport(LOG,
+				(errmsg("invalid WAL summary file \"%s\"", path)));
+		pfree(buf);
+		return false;
+	}
+
+	p = buf + sizeof(hdr);
+	for (i = 0; i < hdr.nentries; i++)
+	{
+		WalSummaryEntry sentry;
+		uint32		j;
+
+		if (p + sizeof(sentry) > end)
+			break;
+		memcpy(&sentry, p, sizeof(sentry));
+		p += sizeof(sentry);
+		if (p + sentry.nblocks * sizeof(BlockNumber) > end)
+			break;
+
+		if (sentry.limit != InvalidBlockNumber)
+			BlockRefTableSetLimit(brtab, &sentry.rnode, sentry.forknum,
+								  sentry.limit);
+		for (j = 0; j < sentry.nblocks; j++)
+		{
+			BlockNumber blkno;
+
+			memcpy(&blkno, p, sizeof(BlockNumber));
+			p += sizeof(BlockNumber);
+			BlockRefTableMarkBlock(brtab, &sentry.rnode, sentry.forknum,
+								   blkno);
+		}
+	}
+	pfree(buf);
+
+	if (i < hdr.nentries)
+	{
+		ereport(LOG,
+				(errmsg("invalid WAL summary file \"%s\"", path)));
+		return false;
+	}
+
+	return true;
+}
+
+
+/* --------------------------------
+ *		signal handler routines
+ * --------------------------------
+ */
+
+/*
+ * summarizer_quickdie() occurs when signalled SIGQUIT by the postmaster.
+ *
+ * Some backend has bought the farm, so we need to stop what we're doing
+ * and exit.  As in wal_quickdie(), don't run the exit callbacks.
+ */
+static void
+summarizer_quickdie(SIGNAL_ARGS)
+{
+	PG_SETMASK(&BlockSig);
+
+	on_exit_reset();
+
+	exit(2);
+}
+
+/* SIGHUP: set flag to re-read config file at next convenient time */
+static void
+SummarizerSigHupHandler(SIGNAL_ARGS)
+{
+	int			save_errno = errno;
+
+	got_SIGHUP = true;
+	SetLatch(MyLatch);
+
+	errno = save_errno;
+}
+
+/* SIGTERM: set flag to exit normally */
+static void
+SummarizerShutdownHandler(SIGNAL_ARGS)
+{
+	int			save_errno = errno;
+
+	shutdown_requested = true;
+	SetLatch(MyLatch);
+
+	errno = save_errno;
+}
+
+/* SIGUSR1: used for latch wakeups */
+static void
+summarizer_sigusr1_handler(SIGNAL_ARGS)
+{
+	int			save_errno = errno;
+
+	latch_sigusr1_handler();
+
+	errno = save_errno;
+}
@@ -16,9 +16,14 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <time.h>
+#include <arpa/inet.h>
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
 
 #include "access/xlog_internal.h"		/* for pg_start/stop_backup */
 #include "catalog/catalog.h"
+#include "catalog/pg_tablespace.h"
 #include "catalog/pg_type.h"
 #include "lib/stringinfo.h"
 #include "libpq/libpq.h"
@@ -27,13 +32,16 @@
 #include "nodes/pg_list.h"
 #include "pgtar.h"
 #include "pgstat.h"
+#include "postmaster/walsummarizer.h"
 #include "replication/basebackup.h"
 #include "replication/walsender.h"
 #include "replication/walsender_private.h"
+#include "storage/bufpage.h"
 #include "storage/fd.h"
 #include "storage/ipc.h"
 #include "utils/builtins.h"
 #include "utils/elog.h"
+#include "utils/memutils.h"
 #include "utils/ps_status.h"
 #include "utils/timestamp.h"
 
@@ -47,6 +55,8 @@ typedef struct
 	bool		includewal;
 	uint32		maxrate;
 	bool		sendtblspcmapfile;
+	int			compresslevel;
+	XLogRecPtr	incremental_lsn;
 } basebackup_options;
 
 
@@ -54,6 +64,15 @@ static int64 sendDir(char *path, int basepathlen, bool sizeonly,
 		List *tablespaces, bool sendtblspclinks);
 static bool sendFile(char *readfilename, char *tarfilename,
 		 struct stat * statbuf, bool missing_ok);
+static bool sendIncrementalFile(char *readfilename, char *tarfilename,
+					struct stat * statbuf, RelFileNode *rnode,
+					BlockNumber segno);
+static bool isRelationDataFile(const char *path, const char *filename,
+				   struct stat * statbuf, RelFileNode *rnode,
+				   BlockNumber *segno);
+static void sendData(const char *data, size_t len);
+static void startCompression(int level);
+static void endCompression(void);
 static void sendFileWithContent(const char *filename, const char *content);
 static void _tarWriteHeader(const char *filename, const char *linktarget,
 				struct stat * statbuf);
@@ -72,6 +91,28 @@ static bool backup_started_in_recovery = false;
 /* Relative path of temporary statistics directory */
 static char *statrelpath = NULL;
 
+/*
+ * If valid, relation data files are sent incrementally, with only the blocks
+ * changed since this LSN.
+ */
+static XLogRecPtr incremental_lsn = InvalidXLogRecPtr;
+
+/*
+ * The blocks modified since incremental_lsn according to the WAL summaries,
+ * if they cover that WAL.  Otherwise the page LSNs are compared.
+ */
+static BlockRefTable *summaries = NULL;
+
+/* OID of the tablespace being sent */
+static Oid	sendtblspc_oid = InvalidOid;
+
+#ifdef HAVE_LIBZ
+/* State of the compression of the current tar stream, if any */
+static bool compressing = false;
+static z_stream zstream;
+static char *compressbuf = NULL;
+#endif
+
 /*
  * Size of each block sent into the tar stream for larger files.
  */
@@ -102,6 +143,16 @@ static void
 base_backup_cleanup(int code, Datum arg)
 {
 	do_pg_abort_backup();
+
+	summaries = NULL;
+
+#ifdef HAVE_LIBZ
+	if (compressing)
+	{
+		deflateEnd(&zstream);
+		compressing = false;
+	}
+#endif
 }
 
 /*
@@ -126,6 +177,8 @@ perform_base_backup(basebackup_options *opt, DIR *tblspcdir)
 
 	backup_started_in_recovery = RecoveryInProgress();
 
+	incremental_lsn = opt->incremental_lsn;
+
 	startptr = do_pg_start_backup(opt->label, opt->fastcheckpoint, &starttli,
 								  &labelfile, tblspcdir, &tablespaces,
 								  &tblspc_map_file,
@@ -145,6 +198,20 @@ perform_base_backup(basebackup_options *opt, DIR *tblspcdir)
 
 		SendXlogRecPtrResult(startptr, starttli);
 
+		/*
+		 * For an incremental backup, find out from the WAL summaries which
+		 * blocks were modified since the previous backup, if we can.
+		 */
+		if (incremental_lsn != InvalidXLogRecPtr && summarize_wal)
+		{
+			summaries = LoadWalSummaries(incremental_lsn, startptr);
+			if (summaries == NULL)
+				ereport(NOTICE,
+						(errmsg("WAL summaries do not cover the WAL since %X/%X, reading all relation files",
+								(uint32) (incremental_lsn >> 32),
+								(uint32) incremental_lsn)));
+		}
+
 		/*
 		 * Calculate the relative path of temporary statistics directory in
 		 * order to skip the files which are located in that directory later.
@@ -201,6 +268,12 @@ perform_base_backup(basebackup_options *opt, DIR *tblspcdir)
 			pq_sendint(&buf, 0, 2);		/* natts */
 			pq_endmessage(&buf);
 
+			if (opt->compresslevel > 0)
+				startCompression(opt->compresslevel);
+
+			sendtblspc_oid = ti->path ? (Oid) strtoul(ti->oid, NULL, 10) :
+				DEFAULTTABLESPACE_OID;
+
 			if (ti->path == NULL)
 			{
 				struct stat statbuf;
@@ -242,11 +315,21 @@ perform_base_backup(basebackup_options *opt, DIR *tblspcdir)
 				Assert(lnext(lc) == NULL);
 			}
 			else
+			{
+				if (opt->compresslevel > 0)
+					endCompression();
 				pq_putemptymessage('c');		/* CopyDone */
+			}
 		}
 	}
 	PG_END_ENSURE_ERROR_CLEANUP(base_backup_cleanup, (Datum) 0);
 
+	if (summaries)
+	{
+		MemoryContextDelete(summaries->cxt);
+		summaries = NULL;
+	}
+
 	endptr = do_pg_stop_backup(labelfile, !opt->nowait, &endtli);
 
 	if (opt->includewal)
@@ -418,9 +501,7 @@ perform_base_backup(basebackup_options *opt, DIR *tblspcdir)
 			{
 				CheckXLogRemoved(segno, tli);
 				/* Send the chunk as a CopyData message */
-				if (pq_putmessage('d', buf, cnt))
-					ereport(ERROR,
-							(errmsg("base backup could not send data, aborting backup")));
+				sendData(buf, cnt);
 
 				len += cnt;
 				throttle(cnt);
@@ -479,6 +560,8 @@ perform_base_backup(basebackup_options *opt, DIR *tblspcdir)
 		}
 
 		/* Send CopyDone message for the last tar file */
+		if (opt->compresslevel > 0)
+			endCompression();
 		pq_putemptymessage('c');
 	}
 	SendXlogRecPtrResult(endptr, endtli);
@@ -511,6 +594,8 @@ parse_basebackup_options(List *options, basebackup_options *opt)
 	bool		o_wal = false;
 	bool		o_maxrate = false;
 	bool		o_tablespace_map = false;
+	bool		o_compress = false;
+	bool		o_incremental = false;
 
 	MemSet(opt, 0, sizeof(*opt));
 	foreach(lopt, options)
@@ -590,6 +675,49 @@ parse_basebackup_options(List *options, basebackup_options *opt)
 			opt->sendtblspcmapfile = true;
 			o_tablespace_map = true;
 		}
+		else if (strcmp(defel->defname, "compress") == 0)
+		{
+			long		level;
+
+			if (o_compress)
+				ereport(ERROR,
+						(errcode(ERRCODE_SYNTAX_ERROR),
+						 errmsg("duplicate option \"%s\"", defel->defname)));
+
+			level = intVal(defel->arg);
+			if (level < 1 || level > 9)
+				ereport(ERROR,
+						(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+						 errmsg("%d is outside the valid range for parameter \"%s\" (%d .. %d)",
+								(int) level, "COMPRESS", 1, 9)));
+#ifndef HAVE_LIBZ
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("compression is not supported by this build")));
+#endif
+
+			opt->compresslevel = (int) level;
+			o_compress = true;
+		}
+		else if (strcmp(defel->defname, "incremental") == 0)
+		{
+			uint32		hi,
+						lo;
+
+			if (o_incremental)
+				ereport(ERROR,
+						(errcode(ERRCODE_SYNTAX_ERROR),
+						 errmsg("duplicate option \"%s\"", defel->defname)));
+
+			if (sscanf(strVal(defel->arg), "%X/%X", &hi, &lo) != 2)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("invalid value for parameter \"%s\": \"%s\"",
+								"INCREMENTAL", strVal(defel->arg))));
+
+			opt->incremental_lsn = ((uint64) hi) << 32 | lo;
+			o_incremental = true;
+		}
 		else
 			elog(ERROR, "option \"%s\" not recognized",
 				 defel->defname);
@@ -798,7 +926,7 @@ sendFileWithContent(const char *filename, const char *content)
 
 	_tarWriteHeader(filename, NULL, &statbuf);
 	/* Send the contents as a CopyData message */
-	pq_putmessage('d', content, len);
+	sendData(content, len);
 
 	/* Pad to 512 byte boundary, per tar format requirements */
 	pad = ((len + 511) & ~511) - len;
@@ -807,7 +935,7 @@ sendFileWithContent(const char *filename, const char *content)
 		char		buf[512];
 
 		MemSet(buf, 0, pad);
-		pq_putmessage('d', buf, pad);
+		sendData(buf, pad);
 	}
 }
 
@@ -1098,8 +1226,20 @@ sendDir(char *path, int basepathlen, bool sizeonly, List *tablespaces,
 			bool		sent = false;
 
 			if (!sizeonly)
-				sent = sendFile(pathbuf, pathbuf + basepathlen + 1, &statbuf,
-								true);
+			{
+				RelFileNode rnode;
+				BlockNumber segno;
+
+				if (incremental_lsn != InvalidXLogRecPtr &&
+					isRelationDataFile(path, de->d_name, &statbuf,
+									   &rnode, &segno))
+					sent = sendIncrementalFile(pathbuf,
+											   pathbuf + basepathlen + 1,
+											   &statbuf, &rnode, segno);
+				else
+					sent = sendFile(pathbuf, pathbuf + basepathlen + 1,
+									&statbuf, true);
+			}
 
 			if (sent || sizeonly)
 			{
@@ -1172,9 +1312,7 @@ sendFile(char *readfilename, char *tarfilename, struct stat * statbuf,
 	while ((cnt = fread(buf, 1, Min(sizeof(buf), statbuf->st_size - len), fp)) > 0)
 	{
 		/* Send the chunk as a CopyData message */
-		if (pq_putmessage('d', buf, cnt))
-			ereport(ERROR,
-			   (errmsg("base backup could not send data, aborting backup")));
+		sendData(buf, cnt);
 
 		len += cnt;
 		throttle(cnt);
@@ -1197,7 +1335,7 @@ sendFile(char *readfilename, char *tarfilename, struct stat * statbuf,
 		while (len < statbuf->st_size)
 		{
 			cnt = Min(sizeof(buf), statbuf->st_size - len);
-			pq_putmessage('d', buf, cnt);
+			sendData(buf, cnt);
 			len += cnt;
 			throttle(cnt);
 		}
@@ -1211,14 +1349,313 @@ sendFile(char *readfilename, char *tarfilename, struct stat * statbuf,
 	if (pad > 0)
 	{
 		MemSet(buf, 0, pad);
-		pq_putmessage('d', buf, pad);
+		sendData(buf, pad);
+	}
+
+	FreeFile(fp);
+
+	return true;
+}
+
+/*
+ * Does the regular file 'filename' in directory 'path' hold data of a
+ * relation's main fork, which can be sent incrementally?
+ *
+ * These are the files named after a relfilenode, possibly with a segment
+ * number, in the global directory or in a database directory.  The other
+ * forks are always sent whole: the free space map isn't WAL-logged, and
+ * clearing visibility map bits doesn't advance the page LSN.
+ *
+ * If so, *rnode and *segno are set to the relation and segment number.
+ */
+static bool
+isRelationDataFile(const char *path, const char *filename,
+				   struct stat * statbuf, RelFileNode *rnode,
+				   BlockNumber *segno)
+{
+	const char *dirname;
+	size_t		len;
+
+	if (statbuf->st_size % BLCKSZ != 0)
+		return false;
+
+	/* digits, optionally followed by a dot and more digits */
+	len = strspn(filename, "0123456789");
+	if (len == 0)
+		return false;
+	if (filename[len] == '.')
+	{
+		size_t		seglen = strspn(filename + len + 1, "0123456789");
+
+		if (seglen == 0)
+			return false;
+		len += 1 + seglen;
+	}
+	if (filename[len] != '\0')
+		return false;
+
+	rnode->relNode = (Oid) strtoul(filename, NULL, 10);
+	*segno = strchr(filename, '.') ?
+		(BlockNumber) strtoul(strchr(filename, '.') + 1, NULL, 10) : 0;
+
+	/* in global, or in a directory named after a database OID */
+	dirname = last_dir_separator(path);
+	dirname = dirname ? dirname + 1 : path;
+	if (strcmp(path, "./global") == 0)
+	{
+		rnode->spcNode = GLOBALTABLESPACE_OID;
+		rnode->dbNode = InvalidOid;
+		return true;
+	}
+	if (dirname[0] == '\0' ||
+		strspn(dirname, "0123456789") != strlen(dirname))
+		return false;
+	rnode->spcNode = sendtblspc_oid;
+	rnode->dbNode = (Oid) strtoul(dirname, NULL, 10);
+	return true;
+}
+
+/*
+ * Send a relation data file incrementally: only the blocks whose LSN is
+ * newer than incremental_lsn, and those that have no LSN because they are
+ * new or not WAL-logged.  The other blocks can't have changed since the
+ * reference backup was started, because the checkpoint that started that
+ * backup flushed them and any later change would have advanced the LSN.
+ *
+ * Without WAL summaries, the file is read twice: once to find the blocks to
+ * send, so that we know the size of the tar member, and once to send them.
+ * If a block changes in between, it will be fixed by replaying WAL from the
+ * start of this backup, just like in a full backup.  With summaries, only
+ * the blocks they list are read.
+ *
+ * Returns false if the file went away before we could open it.
+ */
+static bool
+sendIncrementalFile(char *readfilename, char *tarfilename,
+					struct stat * statbuf, RelFileNode *rnode,
+					BlockNumber segno)
+{
+	FILE	   *fp;
+	char		buf[BLCKSZ];
+	uint32	   *blocks;
+	uint32		nblocks;
+	uint32		nsent = 0;
+	uint32		flags = 0;
+	uint32		i;
+	IncrementalFileHeader hdr;
+	struct stat tarstat;
+	char		tarname[MAXPGPATH];
+	pgoff_t		len;
+	size_t		pad;
+
+	if (summaries)
+	{
+		RelFileNode dbnode = *rnode;
+
+		/* The files of a database copied since are sent whole */
+		dbnode.relNode = InvalidOid;
+		if (BlockRefTableLookup(summaries, &dbnode, MAIN_FORKNUM) != NULL)
+			return sendFile(readfilename, tarfilename, statbuf, true);
+	}
+
+	fp = AllocateFile(readfilename, "rb");
+	if (fp == NULL)
+	{
+		if (errno == ENOENT)
+			return false;
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not open file \"%s\": %m", readfilename)));
+	}
+
+	/* Find the blocks to send */
+	nblocks = statbuf->st_size / BLCKSZ;
+	blocks = (uint32 *) palloc(Max(nblocks, 1) * sizeof(uint32));
+	if (summaries)
+	{
+		BlockRefEntry *entry;
+		BlockNumber segstart = segno * RELSEG_SIZE;
+
+		entry = BlockRefTableLookup(summaries, rnode, MAIN_FORKNUM);
+		if (entry)
+		{
+			uint32		j = 0;
+
+			/* the listed blocks, and all from the limit on */
+			for (i = 0; i < nblocks; i++)
+			{
+				while (j < entry->nblocks && entry->blocks[j] < segstart + i)
+					j++;
+				if ((j < entry->nblocks && entry->blocks[j] == segstart + i) ||
+					(entry->limit != InvalidBlockNumber &&
+					 segstart + i >= entry->limit))
+					blocks[nsent++] = i;
+			}
+		}
+		flags |= INCREMENTAL_FILE_SUMMARIZED;
+	}
+	else
+	{
+		for (i = 0; i < nblocks; i++)
+		{
+			Page		page = (Page) buf;
+
+			if (fread(buf, 1, BLCKSZ, fp) != BLCKSZ)
+			{
+				/* truncated while we were reading, send the rest anyway */
+				for (; i < nblocks; i++)
+					blocks[nsent++] = i;
+				break;
+			}
+
+			if (PageIsNew(page) || PageGetLSN(page) == InvalidXLogRecPtr ||
+				PageGetLSN(page) > incremental_lsn)
+				blocks[nsent++] = i;
+
+			if (i % 1024 == 0)
+				CHECK_FOR_INTERRUPTS();
+		}
+	}
+
+	len = sizeof(IncrementalFileHeader) + (pgoff_t) nsent * sizeof(uint32) +
+		(pgoff_t) nsent * BLCKSZ;
+	if (len > MAX_TAR_MEMBER_FILELEN)
+		ereport(ERROR,
+				(errmsg("archive member \"%s\" too large for tar format",
+						tarfilename)));
+
+	snprintf(tarname, sizeof(tarname), "%s%s", tarfilename,
+			 INCREMENTAL_FILE_SUFFIX);
+	tarstat = *statbuf;
+	tarstat.st_size = len;
+	_tarWriteHeader(tarname, NULL, &tarstat);
+
+	hdr.magic = htonl(INCREMENTAL_FILE_MAGIC);
+	hdr.blcksz = htonl(BLCKSZ);
+	hdr.nblocks = htonl(nblocks);
+	hdr.nsent = htonl(nsent);
+	hdr.flags = htonl(flags);
+	sendData((char *) &hdr, sizeof(hdr));
+
+	for (i = 0; i < nsent; i++)
+	{
+		uint32		blkno = htonl(blocks[i]);
+
+		sendData((char *) &blkno, sizeof(blkno));
+	}
+
+	for (i = 0; i < nsent; i++)
+	{
+		/* If the file was truncated while we were sending it, send zeros */
+		if (fseeko(fp, (pgoff_t) blocks[i] * BLCKSZ, SEEK_SET) != 0 ||
+			fread(buf, 1, BLCKSZ, fp) != BLCKSZ)
+			MemSet(buf, 0, BLCKSZ);
+
+		sendData(buf, BLCKSZ);
+		throttle(BLCKSZ);
+	}
+
+	/* Pad to 512 byte boundary, per tar format requirements */
+	pad = ((len + 511) & ~511) - len;
+	if (pad > 0)
+	{
+		MemSet(buf, 0, pad);
+		sendData(buf, pad);
 	}
 
+	pfree(blocks);
 	FreeFile(fp);
 
 	return true;
 }
 
+/*
+ * Send data of the current tar stream to the client as CopyData messages,
+ * compressing it first if requested.
+ */
+static void
+sendData(const char *data, size_t len)
+{
+#ifdef HAVE_LIBZ
+	if (compressing)
+	{
+		zstream.next_in = (Bytef *) data;
+		zstream.avail_in = len;
+		do
+		{
+			zstream.next_out = (Bytef *) compressbuf;
+			zstream.avail_out = TAR_SEND_SIZE;
+			if (deflate(&zstream, Z_NO_FLUSH) == Z_STREAM_ERROR)
+				elog(ERROR, "could not compress data: %s",
+					 zstream.msg ? zstream.msg : "unknown error");
+			if (zstream.avail_out < TAR_SEND_SIZE &&
+				pq_putmessage('d', compressbuf,
+							  TAR_SEND_SIZE - zstream.avail_out))
+				ereport(ERROR,
+						(errmsg("base backup could not send data, aborting backup")));
+		} while (zstream.avail_out == 0);
+		Assert(zstream.avail_in == 0);
+		return;
+	}
+#endif
+
+	if (pq_putmessage('d', data, len))
+		ereport(ERROR,
+				(errmsg("base backup could not send data, aborting backup")));
+}
+
+/*
+ * Start compressing a tar stream with gzip, so that the client receives a
+ * .tar.gz file.
+ */
+static void
+startCompression(int level)
+{
+#ifdef HAVE_LIBZ
+	if (compressbuf == NULL)
+		compressbuf = MemoryContextAlloc(TopMemoryContext, TAR_SEND_SIZE);
+
+	MemSet(&zstream, 0, sizeof(zstream));
+	/* 16 + MAX_WBITS asks for a gzip header and trailer */
+	if (deflateInit2(&zstream, level, Z_DEFLATED, 16 + MAX_WBITS, 8,
+					 Z_DEFAULT_STRATEGY) != Z_OK)
+		elog(ERROR, "could not initialize compression library: %s",
+			 zstream.msg ? zstream.msg : "unknown error");
+	compressing = true;
+#endif
+}
+
+/*
+ * Finish the compressed stream started by startCompression.
+ */
+static void
+endCompression(void)
+{
+#ifdef HAVE_LIBZ
+	int			rc;
+
+	Assert(compressing);
+	zstream.next_in = NULL;
+	zstream.avail_in = 0;
+	do
+	{
+		zstream.next_out = (Bytef *) compressbuf;
+		zstream.avail_out = TAR_SEND_SIZE;
+		rc = deflate(&zstream, Z_FINISH);
+		if (rc == Z_STREAM_ERROR)
+			elog(ERROR, "could not compress data: %s",
+				 zstream.msg ? zstream.msg : "unknown error");
+		if (zstream.avail_out < TAR_SEND_SIZE &&
+			pq_putmessage('d', compressbuf, TAR_SEND_SIZE - zstream.avail_out))
+			ereport(ERROR,
+					(errmsg("base backup could not send data, aborting backup")));
+	} while (rc != Z_STREAM_END);
+
+	deflateEnd(&zstream);
+	compressing = false;
+#endif
+}
+
 
 static void
 _tarWriteHeader(const char *filename, const char *linktarget,
@@ -1249,7 +1686,7 @@ _tarWriteHeader(const char *filename, const char *linktarget,
 			elog(ERROR, "unrecognized tar error: %d", rc);
 	}
 
-	pq_putmessage('d', h, 512);
+	sendData(h, 512);
 }
 
 /*
@@ -1289,9 +1726,11 @@ throttle(size_t increment)
 		 * (TAR_SEND_SIZE / throttling_sample * elapsed_min_unit) should be
 		 * the maximum time to sleep. Thus the cast to long is safe.
 		 */
+		pgstat_report_wait_start(WAIT_EVENT_BASE_BACKUP_THROTTLE);
 		wait_result = WaitLatch(MyLatch,
 							 WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
 								(long) (sleep / 1000));
+		pgstat_report_wait_end();
 
 		if (wait_result & WL_LATCH_SET)
 			CHECK_FOR_INTERRUPTS();
@@ -31,9 +31,12 @@
  *	  smallest current LSN from the heap.
  *
  *	  In order to cope with large transactions - which can be several times as
- *	  big as the available memory - this module supports spooling the contents
- *	  of a large transactions to disk. When the transaction is replayed the
- *	  contents of individual (sub-)transactions will be read from disk in
+ *	  big as the available memory - the memory used by all changes is tracked,
+ *	  and once it exceeds logical_decoding_work_mem the largest transaction
+ *	  is evicted.  If the output plugin supports it, the changes decoded so
+ *	  far are streamed to it right away (see ReorderBufferStreamTXN());
+ *	  otherwise they are spooled to disk, and when the transaction is replayed
+ *	  the contents of individual (sub-)transactions will be read from disk in
  *	  chunks.
  *
  *	  This module also has to deal with reassembling toast records from the
@@ -61,13 +64,12 @@
 #include "replication/logical.h"
 #include "replication/reorderbuffer.h"
 #include "replication/slot.h"
-#include "replication/snapbuild.h"		/* just for SnapBuildSnapDecRefcount */
+#include "replication/snapbuild.h"
 #include "storage/bufmgr.h"
 #include "storage/fd.h"
 #include "storage/sinval.h"
 #include "utils/builtins.h"
 #include "utils/combocid.h"
-#include "utils/memdebug.h"
 #include "utils/memutils.h"
 #include "utils/relcache.h"
 #include "utils/relfilenodemap.h"
@@ -136,29 +138,18 @@ typedef struct ReorderBufferDiskChange
 } ReorderBufferDiskChange;
 
 /*
- * Maximum number of changes kept in memory, per transaction. After that,
- * changes are spooled to disk.
- *
- * The current value should be sufficient to decode the entire transaction
- * without hitting disk in OLTP workloads, while starting to spool to disk in
- * other workloads reasonably fast.
- *
- * At some point in the future it probably makes sense to have a more elaborate
- * resource management here, but it's not entirely clear what that would look
- * like.
+ * Maximum amount of memory, in kB, used by the changes of all transactions
+ * before the largest one is streamed or spooled to disk.
  */
-static const Size max_changes_in_memory = 4096;
+int			logical_decoding_work_mem = 65536;
 
 /*
- * We use a very simple form of a slab allocator for frequently allocated
- * objects, simply keeping a fixed number in a linked list when unused,
- * instead pfree()ing them. Without that in many workloads aset.c becomes a
- * major bottleneck, especially when spilling to disk while decoding batch
- * workloads.
+ * Maximum number of changes restored from disk at once, per transaction.
  */
-static const Size max_cached_changes = 4096 * 2;
-static const Size max_cached_tuplebufs = 4096 * 2;		/* ~8MB */
-static const Size max_cached_transactions = 512;
+static const Size max_changes_in_memory = 4096;
+
+/* stdio buffer size used when spooling changes to disk */
+#define REORDER_BUFFER_SPILL_BUFSIZE	(64 * 1024)
 
 
 /* ---------------------------------------
@@ -172,6 +163,8 @@ static ReorderBufferTXN *ReorderBufferTXNByXid(ReorderBuffer *rb,
 					  XLogRecPtr lsn, bool create_as_top);
 
 static void AssertTXNLsnOrder(ReorderBuffer *rb);
+static void ReorderBufferTransferSnapToParent(ReorderBufferTXN *txn,
+								  ReorderBufferTXN *subtxn);
 
 /* ---------------------------------------
  * support functions for lsn-order iterating over the ->changes of a
@@ -187,16 +180,31 @@ static ReorderBufferChange *
 static void ReorderBufferIterTXNFinish(ReorderBuffer *rb,
 						   ReorderBufferIterTXNState *state);
 static void ReorderBufferExecuteInvalidations(ReorderBuffer *rb, ReorderBufferTXN *txn);
+static void ReorderBufferProcessTXN(ReorderBuffer *rb, ReorderBufferTXN *txn,
+						XLogRecPtr commit_lsn, bool streaming);
+
+/*
+ * ---------------------------------------
+ * Memory accounting and streaming of in-progress transactions
+ * ---------------------------------------
+ */
+static Size ReorderBufferChangeSize(ReorderBufferChange *change);
+static void ReorderBufferChangeMemoryUpdate(ReorderBuffer *rb,
+								ReorderBufferChange *change, bool addition);
+static void ReorderBufferCheckMemoryLimit(ReorderBuffer *rb);
+static bool ReorderBufferCanStream(ReorderBuffer *rb);
+static bool ReorderBufferTXNCanStream(ReorderBufferTXN *txn);
+static void ReorderBufferStreamTXN(ReorderBuffer *rb, ReorderBufferTXN *txn);
+static void ReorderBufferTruncateTXN(ReorderBuffer *rb, ReorderBufferTXN *txn);
 
 /*
  * ---------------------------------------
  * Disk serialization support functions
  * ---------------------------------------
  */
-static void ReorderBufferCheckSerializeTXN(ReorderBuffer *rb, ReorderBufferTXN *txn);
 static void ReorderBufferSerializeTXN(ReorderBuffer *rb, ReorderBufferTXN *txn);
 static void ReorderBufferSerializeChange(ReorderBuffer *rb, ReorderBufferTXN *txn,
-							 int fd, ReorderBufferChange *change);
+							 FILE *file, ReorderBufferChange *change);
 static Size ReorderBufferRestoreChanges(ReorderBuffer *rb, ReorderBufferTXN *txn,
 							int *fd, XLogSegNo *segno);
 static void ReorderBufferRestoreChange(ReorderBuffer *rb, ReorderBufferTXN *txn,
@@ -243,6 +251,26 @@ ReorderBufferAllocate(void)
 
 	buffer->context = new_ctx;
 
+	/*
+	 * Frequently allocated objects get their own contexts.  Without that,
+	 * aset.c becomes a major bottleneck in many workloads, especially when
+	 * spilling to disk while decoding batch workloads, and never gives the
+	 * memory of a big transaction back once it has been decoded.
+	 */
+	buffer->change_context = SlabContextCreate(new_ctx,
+											   "Change",
+											   SLAB_DEFAULT_BLOCK_SIZE,
+											   sizeof(ReorderBufferChange));
+
+	buffer->txn_context = SlabContextCreate(new_ctx,
+											"TXN",
+											SLAB_DEFAULT_BLOCK_SIZE,
+											sizeof(ReorderBufferTXN));
+
+	buffer->tup_context = GenerationContextCreate(new_ctx,
+												  "Tuples",
+												  SLAB_LARGE_BLOCK_SIZE);
+
 	hash_ctl.keysize = sizeof(TransactionId);
 	hash_ctl.entrysize = sizeof(ReorderBufferTXNByIdEnt);
 	hash_ctl.hcxt = buffer->context;
@@ -253,19 +281,13 @@ ReorderBufferAllocate(void)
 	buffer->by_txn_last_xid = InvalidTransactionId;
 	buffer->by_txn_last_txn = NULL;
 
-	buffer->nr_cached_transactions = 0;
-	buffer->nr_cached_changes = 0;
-	buffer->nr_cached_tuplebufs = 0;
-
 	buffer->outbuf = NULL;
 	buffer->outbufsize = 0;
+	buffer->size = 0;
 
 	buffer->current_restart_decoding_lsn = InvalidXLogRecPtr;
 
 	dlist_init(&buffer->toplevel_by_lsn);
-	dlist_init(&buffer->cached_transactions);
-	dlist_init(&buffer->cached_changes);
-	slist_init(&buffer->cached_tuplebufs);
 
 	return buffer;
 }
@@ -286,28 +308,15 @@ ReorderBufferFree(ReorderBuffer *rb)
 }
 
 /*
- * Get an unused, possibly preallocated, ReorderBufferTXN.
+ * Get a new ReorderBufferTXN.
  */
 static ReorderBufferTXN *
 ReorderBufferGetTXN(ReorderBuffer *rb)
 {
 	ReorderBufferTXN *txn;
 
-	/* check the slab cache */
-	if (rb->nr_cached_transactions > 0)
-	{
-		rb->nr_cached_transactions--;
-		txn = (ReorderBufferTXN *)
-			dlist_container(ReorderBufferTXN, node,
-							dlist_pop_head_node(&rb->cached_transactions));
-	}
-	else
-	{
-		txn = (ReorderBufferTXN *)
-			MemoryContextAlloc(rb->context, sizeof(ReorderBufferTXN));
-	}
-
-	memset(txn, 0, sizeof(ReorderBufferTXN));
+	txn = (ReorderBufferTXN *)
+		MemoryContextAllocZero(rb->txn_context, sizeof(ReorderBufferTXN));
 
 	dlist_init(&txn->changes);
 	dlist_init(&txn->tuplecids);
@@ -318,9 +327,6 @@ ReorderBufferGetTXN(ReorderBuffer *rb)
 
 /*
  * Free a ReorderBufferTXN.
- *
- * Deallocation might be delayed for efficiency purposes, for details check
- * the comments above max_cached_changes's definition.
  */
 static void
 ReorderBufferReturnTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
@@ -346,55 +352,38 @@ ReorderBufferReturnTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
 		txn->invalidations = NULL;
 	}
 
-	/* check whether to put into the slab cache */
-	if (rb->nr_cached_transactions < max_cached_transactions)
-	{
-		rb->nr_cached_transactions++;
-		dlist_push_head(&rb->cached_transactions, &txn->node);
-		VALGRIND_MAKE_MEM_UNDEFINED(txn, sizeof(ReorderBufferTXN));
-		VALGRIND_MAKE_MEM_DEFINED(&txn->node, sizeof(txn->node));
-	}
-	else
+	if (txn->snapshot_now != NULL)
 	{
-		pfree(txn);
+		ReorderBufferFreeSnap(rb, txn->snapshot_now);
+		txn->snapshot_now = NULL;
 	}
+
+	pfree(txn);
 }
 
 /*
- * Get an unused, possibly preallocated, ReorderBufferChange.
+ * Get a new ReorderBufferChange.
  */
 ReorderBufferChange *
 ReorderBufferGetChange(ReorderBuffer *rb)
 {
 	ReorderBufferChange *change;
 
-	/* check the slab cache */
-	if (rb->nr_cached_changes)
-	{
-		rb->nr_cached_changes--;
-		change = (ReorderBufferChange *)
-			dlist_container(ReorderBufferChange, node,
-							dlist_pop_head_node(&rb->cached_changes));
-	}
-	else
-	{
-		change = (ReorderBufferChange *)
-			MemoryContextAlloc(rb->context, sizeof(ReorderBufferChange));
-	}
+	change = (ReorderBufferChange *)
+		MemoryContextAllocZero(rb->change_context, sizeof(ReorderBufferChange));
 
-	memset(change, 0, sizeof(ReorderBufferChange));
 	return change;
 }
 
 /*
  * Free an ReorderBufferChange.
- *
- * Deallocation might be delayed for efficiency purposes, for details check
- * the comments above max_cached_changes's definition.
  */
 void
 ReorderBufferReturnChange(ReorderBuffer *rb, ReorderBufferChange *change)
 {
+	/* the memory isn't used by the transaction anymore */
+	ReorderBufferChangeMemoryUpdate(rb, change, false);
+
 	/* free contained data */
 	switch (change->action)
 	{
@@ -428,69 +417,31 @@ ReorderBufferReturnChange(ReorderBuffer *rb, ReorderBufferChange *change)
 			break;
 	}
 
-	/* check whether to put into the slab cache */
-	if (rb->nr_cached_changes < max_cached_changes)
-	{
-		rb->nr_cached_changes++;
-		dlist_push_head(&rb->cached_changes, &change->node);
-		VALGRIND_MAKE_MEM_UNDEFINED(change, sizeof(ReorderBufferChange));
-		VALGRIND_MAKE_MEM_DEFINED(&change->node, sizeof(change->node));
-	}
-	else
-	{
-		pfree(change);
-	}
+	pfree(change);
 }
 
 
 /*
- * Get an unused, possibly preallocated, ReorderBufferTupleBuf
+ * Get a new ReorderBufferTupleBuf.
  */
 ReorderBufferTupleBuf *
 ReorderBufferGetTupleBuf(ReorderBuffer *rb)
 {
 	ReorderBufferTupleBuf *tuple;
 
-	/* check the slab cache */
-	if (rb->nr_cached_tuplebufs)
-	{
-		rb->nr_cached_tuplebufs--;
-		tuple = slist_container(ReorderBufferTupleBuf, node,
-								slist_pop_head_node(&rb->cached_tuplebufs));
-#ifdef USE_ASSERT_CHECKING
-		memset(tuple, 0xa9, sizeof(ReorderBufferTupleBuf));
-#endif
-	}
-	else
-	{
-		tuple = (ReorderBufferTupleBuf *)
-			MemoryContextAlloc(rb->context, sizeof(ReorderBufferTupleBuf));
-	}
+	tuple = (ReorderBufferTupleBuf *)
+		MemoryContextAlloc(rb->tup_context, sizeof(ReorderBufferTupleBuf));
 
 	return tuple;
 }
 
 /*
  * Free an ReorderBufferTupleBuf.
- *
- * Deallocation might be delayed for efficiency purposes, for details check
- * the comments above max_cached_changes's definition.
  */
 void
 ReorderBufferReturnTupleBuf(ReorderBuffer *rb, ReorderBufferTupleBuf *tuple)
 {
-	/* check whether to put into the slab cache */
-	if (rb->nr_cached_tuplebufs < max_cached_tuplebufs)
-	{
-		rb->nr_cached_tuplebufs++;
-		slist_push_head(&rb->cached_tuplebufs, &tuple->node);
-		VALGRIND_MAKE_MEM_UNDEFINED(tuple, sizeof(ReorderBufferTupleBuf));
-		VALGRIND_MAKE_MEM_DEFINED(&tuple->node, sizeof(tuple->node));
-	}
-	else
-	{
-		pfree(tuple);
-	}
+	pfree(tuple);
 }
 
 /*
@@ -591,12 +542,16 @@ ReorderBufferQueueChange(ReorderBuffer *rb, TransactionId xid, XLogRecPtr lsn,
 	txn = ReorderBufferTXNByXid(rb, xid, true, NULL, lsn, true);
 
 	change->lsn = lsn;
+	change->txn = txn;
 	Assert(InvalidXLogRecPtr != lsn);
 	dlist_push_tail(&txn->changes, &change->node);
 	txn->nentries++;
 	txn->nentries_mem++;
 
-	ReorderBufferCheckSerializeTXN(rb, txn);
+	ReorderBufferChangeMemoryUpdate(rb, change, true);
+
+	/* stream or spill the largest transaction, if we're over the limit */
+	ReorderBufferCheckMemoryLimit(rb);
 }
 
 static void
@@ -668,12 +623,15 @@ ReorderBufferAssignChild(ReorderBuffer *rb, TransactionId xid,
 		 * that have not yet produced any records. Knowing those aren't top
 		 * level xids allows us to make processing cheaper in some places.
 		 */
+		subtxn->is_known_as_subxact = true;
+		subtxn->toptxn = txn;
 		dlist_push_tail(&txn->subtxns, &subtxn->node);
 		txn->nsubtxns++;
 	}
 	else if (!subtxn->is_known_as_subxact)
 	{
 		subtxn->is_known_as_subxact = true;
+		subtxn->toptxn = txn;
 		Assert(subtxn->nsubtxns == 0);
 
 		/* remove from lsn order list of top-level transactions */
@@ -682,6 +640,9 @@ ReorderBufferAssignChild(ReorderBuffer *rb, TransactionId xid,
 		/* add to toplevel transaction */
 		dlist_push_tail(&txn->subtxns, &subtxn->node);
 		txn->nsubtxns++;
+
+		/* the toplevel transaction decodes with the oldest base snapshot */
+		ReorderBufferTransferSnapToParent(txn, subtxn);
 	}
 	else if (new_top)
 	{
@@ -715,20 +676,7 @@ ReorderBufferCommitChild(ReorderBuffer *rb, TransactionId xid,
 	if (txn == NULL)
 		elog(ERROR, "subxact logged without previous toplevel record");
 
-	/*
-	 * Pass the our base snapshot to the parent transaction if it doesn't have
-	 * one, or ours is older. That can happen if there are no changes in the
-	 * toplevel transaction but in one of the child transactions. This allows
-	 * the parent to simply use it's base snapshot initially.
-	 */
-	if (txn->base_snapshot == NULL ||
-		txn->base_snapshot_lsn > subtxn->base_snapshot_lsn)
-	{
-		txn->base_snapshot = subtxn->base_snapshot;
-		txn->base_snapshot_lsn = subtxn->base_snapshot_lsn;
-		subtxn->base_snapshot = NULL;
-		subtxn->base_snapshot_lsn = InvalidXLogRecPtr;
-	}
+	ReorderBufferTransferSnapToParent(txn, subtxn);
 
 	subtxn->final_lsn = commit_lsn;
 	subtxn->end_lsn = end_lsn;
@@ -736,6 +684,7 @@ ReorderBufferCommitChild(ReorderBuffer *rb, TransactionId xid,
 	if (!subtxn->is_known_as_subxact)
 	{
 		subtxn->is_known_as_subxact = true;
+		subtxn->toptxn = txn;
 		Assert(subtxn->nsubtxns == 0);
 
 		/* remove from lsn order list of top-level transactions */
@@ -747,6 +696,34 @@ ReorderBufferCommitChild(ReorderBuffer *rb, TransactionId xid,
 	}
 }
 
+/*
+ * Pass the base snapshot of a subtransaction to its parent transaction if
+ * the parent doesn't have one, or the subtransaction's is older. That can
+ * happen if there are no changes in the toplevel transaction but in one of
+ * the child transactions. This allows the parent to simply use its base
+ * snapshot initially.
+ */
+static void
+ReorderBufferTransferSnapToParent(ReorderBufferTXN *txn,
+								  ReorderBufferTXN *subtxn)
+{
+	if (subtxn->base_snapshot == NULL)
+		return;
+
+	if (txn->base_snapshot == NULL ||
+		txn->base_snapshot_lsn > subtxn->base_snapshot_lsn)
+	{
+		if (txn->base_snapshot != NULL)
+			SnapBuildSnapDecRefcount(txn->base_snapshot);
+		txn->base_snapshot = subtxn->base_snapshot;
+		txn->base_snapshot_lsn = subtxn->base_snapshot_lsn;
+	}
+	else
+		SnapBuildSnapDecRefcount(subtxn->base_snapshot);
+
+	subtxn->base_snapshot = NULL;
+	subtxn->base_snapshot_lsn = InvalidXLogRecPtr;
+}
 
 /*
  * Support for efficiently iterating over a transaction's and its
@@ -869,7 +846,7 @@ ReorderBufferIterTXNInit(ReorderBuffer *rb, ReorderBufferTXN *txn)
 		{
 			ReorderBufferChange *cur_change;
 
-			if (txn->nentries != txn->nentries_mem)
+			if (cur_txn->nentries != cur_txn->nentries_mem)
 				ReorderBufferRestoreChanges(rb, cur_txn,
 											&state->entries[off].fd,
 											&state->entries[off].segno);
@@ -1020,6 +997,12 @@ ReorderBufferCleanupTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
 	bool		found;
 	dlist_mutable_iter iter;
 
+	/*
+	 * Reassembled toast chunks may belong to subtransactions, so get rid of
+	 * them before those are gone.
+	 */
+	ReorderBufferToastReset(rb, txn);
+
 	/* cleanup subtransactions & their changes */
 	dlist_foreach_modify(iter, &txn->subtxns)
 	{
@@ -1088,13 +1071,52 @@ ReorderBufferCleanupTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
 	Assert(found);
 
 	/* remove entries spilled to disk */
-	if (txn->nentries != txn->nentries_mem)
+	if (txn->serialized)
 		ReorderBufferRestoreCleanup(rb, txn);
 
 	/* deallocate */
 	ReorderBufferReturnTXN(rb, txn);
 }
 
+/*
+ * Discard the changes of a transaction and its subtransactions that have
+ * been streamed to the output plugin, keeping the transactions themselves
+ * around for the changes still to come.
+ */
+static void
+ReorderBufferTruncateTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
+{
+	dlist_iter	subtxn_i;
+	dlist_mutable_iter iter;
+
+	dlist_foreach(subtxn_i, &txn->subtxns)
+	{
+		ReorderBufferTXN *subtxn;
+
+		subtxn = dlist_container(ReorderBufferTXN, node, subtxn_i.cur);
+		ReorderBufferTruncateTXN(rb, subtxn);
+	}
+
+	dlist_foreach_modify(iter, &txn->changes)
+	{
+		ReorderBufferChange *change;
+
+		change = dlist_container(ReorderBufferChange, node, iter.cur);
+
+		dlist_delete(&change->node);
+		ReorderBufferReturnChange(rb, change);
+	}
+
+	if (txn->serialized)
+	{
+		ReorderBufferRestoreCleanup(rb, txn);
+		txn->serialized = false;
+	}
+
+	txn->nentries = 0;
+	txn->nentries_mem = 0;
+}
+
 /*
  * Build a hash with a (relfilenode, ctid) -> (cmin, cmax) mapping for use by
  * tqual.c's HeapTupleSatisfiesHistoricMVCC.
@@ -1242,61 +1264,66 @@ ReorderBufferFreeSnap(ReorderBuffer *rb, Snapshot snap)
 }
 
 /*
- * Perform the replay of a transaction and it's non-aborted subtransactions.
- *
- * Subtransactions previously have to be processed by
- * ReorderBufferCommitChild(), even if previously assigned to the toplevel
- * transaction with ReorderBufferAssignChild.
+ * Replay the changes of a transaction and its non-aborted subtransactions
+ * queued so far, in lsn order (using a k-way merge).
  *
- * We currently can only decode a transaction's contents in when their commit
- * record is read because that's currently the only place where we know about
- * cache invalidations. Thus, once a toplevel commit is read, we iterate over
- * the top and subtransactions (using a k-way merge) and replay the changes in
- * lsn order.
+ * Without streaming, the whole transaction is passed to the begin, change
+ * and commit callbacks once its commit record has been read.  With
+ * streaming, the changes are passed to the stream callbacks instead.  In that
+ * case commit_lsn is invalid while the transaction is still in progress:
+ * the changes decoded so far are sent as one block and then thrown away,
+ * and the snapshot and command id reached are remembered for the next block.
  */
-void
-ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
-					XLogRecPtr commit_lsn, XLogRecPtr end_lsn,
-					TimestampTz commit_time,
-					RepOriginId origin_id, XLogRecPtr origin_lsn)
+static void
+ReorderBufferProcessTXN(ReorderBuffer *rb, ReorderBufferTXN *txn,
+						XLogRecPtr commit_lsn, bool streaming)
 {
-	ReorderBufferTXN *txn;
 	volatile Snapshot snapshot_now;
-	volatile CommandId command_id = FirstCommandId;
+	volatile CommandId command_id;
 	bool		using_subtxn;
+	bool		committed = (commit_lsn != InvalidXLogRecPtr);
 	ReorderBufferIterTXNState *volatile iterstate = NULL;
-
-	txn = ReorderBufferTXNByXid(rb, xid, false, NULL, InvalidXLogRecPtr,
-								false);
-
-	/* unknown transaction, nothing to replay */
-	if (txn == NULL)
-		return;
-
-	txn->final_lsn = commit_lsn;
-	txn->end_lsn = end_lsn;
-	txn->commit_time = commit_time;
-	txn->origin_id = origin_id;
-	txn->origin_lsn = origin_lsn;
-
-	/* serialize the last bunch of changes if we need start earlier anyway */
-	if (txn->nentries_mem != txn->nentries)
-		ReorderBufferSerializeTXN(rb, txn);
+	dlist_iter	subtxn_i;
 
 	/*
-	 * If this transaction didn't have any real changes in our database, it's
-	 * OK not to have a snapshot. Note that ReorderBufferCommitChild will have
-	 * transferred its snapshot to this transaction if it had one and the
-	 * toplevel tx didn't.
+	 * Changes that have been spilled to disk are restored into memory during
+	 * iteration, which discards the in-memory ones, so serialize the last
+	 * bunch of changes if any part of the transaction hit the disk.
 	 */
-	if (txn->base_snapshot == NULL)
+	if (txn->serialized)
+		ReorderBufferSerializeTXN(rb, txn);
+	else
 	{
-		Assert(txn->ninvalidations == 0);
-		ReorderBufferCleanupTXN(rb, txn);
-		return;
+		dlist_foreach(subtxn_i, &txn->subtxns)
+		{
+			ReorderBufferTXN *subtxn;
+
+			subtxn = dlist_container(ReorderBufferTXN, node, subtxn_i.cur);
+			if (subtxn->serialized)
+			{
+				ReorderBufferSerializeTXN(rb, txn);
+				break;
+			}
+		}
 	}
 
-	snapshot_now = txn->base_snapshot;
+	if (txn->snapshot_now != NULL)
+	{
+		/*
+		 * Continue with the state a previous block ended with.  Copy the
+		 * snapshot again, subtransactions might have been added since.
+		 */
+		command_id = txn->command_id;
+		snapshot_now = ReorderBufferCopySnap(rb, txn->snapshot_now,
+											 txn, command_id);
+		ReorderBufferFreeSnap(rb, txn->snapshot_now);
+		txn->snapshot_now = NULL;
+	}
+	else
+	{
+		command_id = FirstCommandId;
+		snapshot_now = txn->base_snapshot;
+	}
 
 	/* build data to be able to lookup the CommandIds of catalog tuples */
 	ReorderBufferBuildTupleCidHash(rb, txn);
@@ -1326,7 +1353,10 @@ ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
 		else
 			StartTransactionCommand();
 
-		rb->begin(rb, txn);
+		if (streaming)
+			rb->stream_start(rb, txn);
+		else
+			rb->begin(rb, txn);
 
 		iterstate = ReorderBufferIterTXNInit(rb, txn);
 		while ((change = ReorderBufferIterTXNNext(rb, iterstate)) != NULL)
@@ -1393,7 +1423,10 @@ ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
 					if (!IsToastRelation(relation))
 					{
 						ReorderBufferToastReplace(rb, txn, relation, change);
-						rb->apply_change(rb, txn, relation, change);
+						if (streaming)
+							rb->stream_change(rb, txn, relation, change);
+						else
+							rb->apply_change(rb, txn, relation, change);
 
 						/*
 						 * Only clear reassembled toast chunks if we're sure
@@ -1533,23 +1566,51 @@ ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
 			}
 		}
 
-		/*
-		 * There's a speculative insertion remaining, just clean in up, it
-		 * can't have been successful, otherwise we'd gotten a confirmation
-		 * record.
-		 */
-		if (specinsert)
+		/* clean up the iterator */
+		ReorderBufferIterTXNFinish(rb, iterstate);
+		iterstate = NULL;
+
+		if (specinsert != NULL && !committed)
 		{
+			/*
+			 * The confirmation of a pending speculative insertion might still
+			 * arrive, put it back so it's there for the next block.
+			 */
+			dlist_push_head(&specinsert->txn->changes, &specinsert->node);
+			specinsert->txn->nentries++;
+			specinsert->txn->nentries_mem++;
+		}
+		else if (specinsert != NULL)
+		{
+			/*
+			 * There's a speculative insertion remaining, just clean in up, it
+			 * can't have been successful, otherwise we'd gotten a
+			 * confirmation record.
+			 */
 			ReorderBufferReturnChange(rb, specinsert);
-			specinsert = NULL;
 		}
+		specinsert = NULL;
 
-		/* clean up the iterator */
-		ReorderBufferIterTXNFinish(rb, iterstate);
-		iterstate = NULL;
+		if (streaming)
+		{
+			rb->stream_stop(rb, txn);
+
+			txn->streamed = true;
+			dlist_foreach(subtxn_i, &txn->subtxns)
+			{
+				ReorderBufferTXN *subtxn;
+
+				subtxn = dlist_container(ReorderBufferTXN, node, subtxn_i.cur);
+				if (subtxn->nentries > 0)
+					subtxn->streamed = true;
+			}
+		}
 
 		/* call commit callback */
-		rb->commit(rb, txn, commit_lsn);
+		if (committed && streaming)
+			rb->stream_commit(rb, txn, commit_lsn);
+		else if (committed)
+			rb->commit(rb, txn, commit_lsn);
 
 		/* this is just a sanity check against bad output plugin behaviour */
 		if (GetCurrentTransactionIdIfAny() != InvalidTransactionId)
@@ -1573,11 +1634,25 @@ ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
 		if (using_subtxn)
 			RollbackAndReleaseCurrentSubTransaction();
 
-		if (snapshot_now->copied)
-			ReorderBufferFreeSnap(rb, snapshot_now);
+		if (committed)
+		{
+			if (snapshot_now->copied)
+				ReorderBufferFreeSnap(rb, snapshot_now);
 
-		/* remove potential on-disk data, and deallocate */
-		ReorderBufferCleanupTXN(rb, txn);
+			/* remove potential on-disk data, and deallocate */
+			ReorderBufferCleanupTXN(rb, txn);
+		}
+		else
+		{
+			/* remember where to continue, and discard the streamed changes */
+			txn->snapshot_now = ReorderBufferCopySnap(rb, snapshot_now,
+													  txn, command_id);
+			txn->command_id = command_id;
+			if (snapshot_now->copied)
+				ReorderBufferFreeSnap(rb, snapshot_now);
+
+			ReorderBufferTruncateTXN(rb, txn);
+		}
 	}
 	PG_CATCH();
 	{
@@ -1610,6 +1685,57 @@ ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
 	PG_END_TRY();
 }
 
+/*
+ * Perform the replay of a transaction and it's non-aborted subtransactions.
+ *
+ * Subtransactions previously have to be processed by
+ * ReorderBufferCommitChild(), even if previously assigned to the toplevel
+ * transaction with ReorderBufferAssignChild.
+ *
+ * We currently can only decode a transaction's contents in when their commit
+ * record is read because that's currently the only place where we know about
+ * cache invalidations. Thus, once a toplevel commit is read, we iterate over
+ * the top and subtransactions (using a k-way merge) and replay the changes in
+ * lsn order.  If parts of the transaction have already been streamed, the
+ * rest is streamed as well, followed by the stream commit callback.
+ */
+void
+ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
+					XLogRecPtr commit_lsn, XLogRecPtr end_lsn,
+					TimestampTz commit_time,
+					RepOriginId origin_id, XLogRecPtr origin_lsn)
+{
+	ReorderBufferTXN *txn;
+
+	txn = ReorderBufferTXNByXid(rb, xid, false, NULL, InvalidXLogRecPtr,
+								false);
+
+	/* unknown transaction, nothing to replay */
+	if (txn == NULL)
+		return;
+
+	txn->final_lsn = commit_lsn;
+	txn->end_lsn = end_lsn;
+	txn->commit_time = commit_time;
+	txn->origin_id = origin_id;
+	txn->origin_lsn = origin_lsn;
+
+	/*
+	 * If this transaction didn't have any real changes in our database, it's
+	 * OK not to have a snapshot. Note that ReorderBufferCommitChild will have
+	 * transferred its snapshot to this transaction if it had one and the
+	 * toplevel tx didn't.
+	 */
+	if (txn->base_snapshot == NULL)
+	{
+		Assert(txn->ninvalidations == 0);
+		ReorderBufferCleanupTXN(rb, txn);
+		return;
+	}
+
+	ReorderBufferProcessTXN(rb, txn, commit_lsn, txn->streamed);
+}
+
 /*
  * Abort a transaction that possibly has previous changes. Needs to be first
  * called for subtransactions and then for the toplevel xid.
@@ -1637,6 +1763,10 @@ ReorderBufferAbort(ReorderBuffer *rb, TransactionId xid, XLogRecPtr lsn)
 	/* cosmetic... */
 	txn->final_lsn = lsn;
 
+	/* tell the output plugin to throw away what it has been sent */
+	if (txn->streamed)
+		rb->stream_abort(rb, txn, lsn);
+
 	/* remove potential on-disk data, and deallocate */
 	ReorderBufferCleanupTXN(rb, txn);
 }
@@ -1670,6 +1800,9 @@ ReorderBufferAbortOld(ReorderBuffer *rb, TransactionId oldestRunningXid)
 		{
 			elog(DEBUG1, "aborting old transaction %u", txn->xid);
 
+			if (txn->streamed)
+				rb->stream_abort(rb, txn, InvalidXLogRecPtr);
+
 			/* remove potential on-disk data, and deallocate this tx */
 			ReorderBufferCleanupTXN(rb, txn);
 		}
@@ -1735,6 +1868,13 @@ ReorderBufferForget(ReorderBuffer *rb, TransactionId xid, XLogRecPtr lsn)
 	else
 		Assert(txn->ninvalidations == 0);
 
+	/*
+	 * The output plugin has to forget the streamed changes as well, there's
+	 * nobody to send the commit to.
+	 */
+	if (txn->streamed)
+		rb->stream_abort(rb, txn, lsn);
+
 	/* remove potential on-disk data, and deallocate */
 	ReorderBufferCleanupTXN(rb, txn);
 }
@@ -1786,6 +1926,11 @@ ReorderBufferSetBaseSnapshot(ReorderBuffer *rb, TransactionId xid,
 	bool		is_new;
 
 	txn = ReorderBufferTXNByXid(rb, xid, true, &is_new, lsn, true);
+
+	/* the changes of known subtransactions are decoded by the toplevel's */
+	if (txn->is_known_as_subxact)
+		txn = txn->toptxn;
+
 	Assert(txn->base_snapshot == NULL);
 	Assert(snap != NULL);
 
@@ -1923,14 +2068,205 @@ ReorderBufferXidHasBaseSnapshot(ReorderBuffer *rb, TransactionId xid)
 	if (txn == NULL)
 		return false;
 
-	/*
-	 * TODO: It would be a nice improvement if we would check the toplevel
-	 * transaction in subtransactions, but we'd need to keep track of a bit
-	 * more state.
-	 */
+	/* a known subtransaction uses the snapshot of its toplevel transaction */
+	if (txn->is_known_as_subxact)
+		return txn->toptxn->base_snapshot != NULL ||
+			txn->base_snapshot != NULL;
+
 	return txn->base_snapshot != NULL;
 }
 
+/*
+ * ---------------------------------------
+ * Memory accounting and streaming of in-progress transactions
+ * ---------------------------------------
+ */
+
+/*
+ * Amount of memory used by a change, as counted against
+ * logical_decoding_work_mem.
+ *
+ * Tuple buffers are always allocated with room for the largest possible
+ * tuple, so count them at their full size.
+ */
+static Size
+ReorderBufferChangeSize(ReorderBufferChange *change)
+{
+	Size		sz = sizeof(ReorderBufferChange);
+
+	switch (change->action)
+	{
+			/* fall through these, they're all similar enough */
+		case REORDER_BUFFER_CHANGE_INSERT:
+		case REORDER_BUFFER_CHANGE_UPDATE:
+		case REORDER_BUFFER_CHANGE_DELETE:
+		case REORDER_BUFFER_CHANGE_INTERNAL_SPEC_INSERT:
+			if (change->data.tp.oldtuple)
+				sz += sizeof(ReorderBufferTupleBuf);
+			if (change->data.tp.newtuple)
+				sz += sizeof(ReorderBufferTupleBuf);
+			break;
+		case REORDER_BUFFER_CHANGE_INTERNAL_SNAPSHOT:
+		case REORDER_BUFFER_CHANGE_INTERNAL_SPEC_CONFIRM:
+		case REORDER_BUFFER_CHANGE_INTERNAL_COMMAND_ID:
+		case REORDER_BUFFER_CHANGE_INTERNAL_TUPLECID:
+			break;
+	}
+
+	return sz;
+}
+
+/*
+ * Account for a change being added to, or removed from, the memory of the
+ * transaction it was queued to.  Changes not (yet) belonging to a
+ * transaction aren't counted.
+ */
+static void
+ReorderBufferChangeMemoryUpdate(ReorderBuffer *rb,
+								ReorderBufferChange *change, bool addition)
+{
+	Size		sz;
+
+	if (change->txn == NULL)
+		return;
+
+	sz = ReorderBufferChangeSize(change);
+
+	if (addition)
+	{
+		change->txn->size += sz;
+		rb->size += sz;
+	}
+	else
+	{
+		Assert(change->txn->size >= sz && rb->size >= sz);
+		change->txn->size -= sz;
+		rb->size -= sz;
+	}
+}
+
+/*
+ * Can in-progress transactions be streamed to the output plugin at this
+ * point?  That requires the plugin to support it, and we mustn't be at a
+ * point where the commits of transactions might still be skipped.
+ */
+static bool
+ReorderBufferCanStream(ReorderBuffer *rb)
+{
+	LogicalDecodingContext *ctx = rb->private_data;
+
+	return ctx->streaming &&
+		SnapBuildCurrentState(ctx->snapshot_builder) == SNAPBUILD_CONSISTENT &&
+		!SnapBuildXactNeedsSkip(ctx->snapshot_builder, ctx->reader->EndRecPtr);
+}
+
+/*
+ * Can this transaction be streamed before it commits?
+ *
+ * Catalog changes and the matching cache invalidations are only known once
+ * the commit record has been read, so transactions modifying the catalog
+ * are spilled to disk instead.
+ */
+static bool
+ReorderBufferTXNCanStream(ReorderBufferTXN *txn)
+{
+	dlist_iter	iter;
+
+	if (txn->base_snapshot == NULL || txn->has_catalog_changes)
+		return false;
+
+	dlist_foreach(iter, &txn->subtxns)
+	{
+		ReorderBufferTXN *subtxn;
+
+		subtxn = dlist_container(ReorderBufferTXN, node, iter.cur);
+		if (subtxn->has_catalog_changes)
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Stream the changes of an in-progress transaction decoded so far to the
+ * output plugin, and release their memory.
+ */
+static void
+ReorderBufferStreamTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
+{
+	elog(DEBUG2, "streaming changes of in-progress XID %u", txn->xid);
+
+	ReorderBufferProcessTXN(rb, txn, InvalidXLogRecPtr, true);
+}
+
+/*
+ * Check whether the memory used by the changes of all transactions exceeds
+ * logical_decoding_work_mem, and if so evict transactions until it doesn't
+ * anymore.
+ *
+ * The largest toplevel transaction, counting its subtransactions, is picked
+ * each time: that frees the most memory for the least work, and the
+ * transactions that the memory limit is usually hit for tend to be few and
+ * large.  It's streamed if possible, otherwise spilled to disk.
+ */
+static void
+ReorderBufferCheckMemoryLimit(ReorderBuffer *rb)
+{
+	bool		can_stream;
+
+	if (rb->size < logical_decoding_work_mem * 1024L)
+		return;
+
+	can_stream = ReorderBufferCanStream(rb);
+
+	while (rb->size >= logical_decoding_work_mem * 1024L)
+	{
+		ReorderBufferTXN *largest = NULL;
+		Size		largest_size = 0;
+		Size		size_before = rb->size;
+		dlist_iter	iter;
+
+		dlist_foreach(iter, &rb->toplevel_by_lsn)
+		{
+			ReorderBufferTXN *txn;
+			Size		size;
+			dlist_iter	subtxn_i;
+
+			txn = dlist_container(ReorderBufferTXN, node, iter.cur);
+
+			size = txn->size;
+			dlist_foreach(subtxn_i, &txn->subtxns)
+			{
+				ReorderBufferTXN *subtxn;
+
+				subtxn = dlist_container(ReorderBufferTXN, node, subtxn_i.cur);
+				size += subtxn->size;
+			}
+
+			if (size > largest_size)
+			{
+				largest = txn;
+				largest_size = size;
+			}
+		}
+
+		if (largest == NULL)
+			break;
+
+		if (can_stream && ReorderBufferTXNCanStream(largest))
+			ReorderBufferStreamTXN(rb, largest);
+		else
+			ReorderBufferSerializeTXN(rb, largest);
+
+		/*
+		 * Reassembled toast chunks stay in memory until the tuple they belong
+		 * to has been decoded, so evicting might not have freed anything.
+		 */
+		if (rb->size >= size_before)
+			break;
+	}
+}
+
 
 /*
  * ---------------------------------------
@@ -1956,23 +2292,6 @@ ReorderBufferSerializeReserve(ReorderBuffer *rb, Size sz)
 	}
 }
 
-/*
- * Check whether the transaction tx should spill its data to disk.
- */
-static void
-ReorderBufferCheckSerializeTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
-{
-	/*
-	 * TODO: improve accounting so we cheaply can take subtransactions into
-	 * account here.
-	 */
-	if (txn->nentries_mem >= max_changes_in_memory)
-	{
-		ReorderBufferSerializeTXN(rb, txn);
-		Assert(txn->nentries_mem == 0);
-	}
-}
-
 /*
  * Spill data of a large transaction (and its subtransactions) to disk.
  */
@@ -1981,7 +2300,8 @@ ReorderBufferSerializeTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
 {
 	dlist_iter	subtxn_i;
 	dlist_mutable_iter change_i;
-	int			fd = -1;
+	FILE	   *file = NULL;
+	char	   *filebuf = NULL;
 	XLogSegNo	curOpenSegNo = 0;
 	Size		spilled = 0;
 	char		path[MAXPGPATH];
@@ -2009,12 +2329,15 @@ ReorderBufferSerializeTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
 		 * store in segment in which it belongs by start lsn, don't split over
 		 * multiple segments tho
 		 */
-		if (fd == -1 || XLByteInSeg(change->lsn, curOpenSegNo))
+		if (file == NULL || !XLByteInSeg(change->lsn, curOpenSegNo))
 		{
 			XLogRecPtr	recptr;
 
-			if (fd != -1)
-				CloseTransientFile(fd);
+			if (file != NULL && FreeFile(file) != 0)
+				ereport(ERROR,
+						(errcode_for_file_access(),
+						 errmsg("could not write to file \"%s\": %m",
+								path)));
 
 			XLByteToSeg(change->lsn, curOpenSegNo);
 			XLogSegNoOffsetToRecPtr(curOpenSegNo, 0, recptr);
@@ -2028,18 +2351,29 @@ ReorderBufferSerializeTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
 					(uint32) (recptr >> 32), (uint32) recptr);
 
 			/* open segment, create it if necessary */
-			fd = OpenTransientFile(path,
-								   O_CREAT | O_WRONLY | O_APPEND | PG_BINARY,
-								   S_IRUSR | S_IWUSR);
+			file = AllocateFile(path, PG_BINARY_A);
 
-			if (fd < 0)
+			if (file == NULL)
 				ereport(ERROR,
 						(errcode_for_file_access(),
 						 errmsg("could not open file \"%s\": %m",
 								path)));
+
+			/*
+			 * Changes are usually small, so write them out in large chunks
+			 * rather than issuing a write() for each of them.
+			 */
+			if (filebuf == NULL)
+				filebuf = palloc(REORDER_BUFFER_SPILL_BUFSIZE);
+			setvbuf(file, filebuf, _IOFBF, REORDER_BUFFER_SPILL_BUFSIZE);
 		}
 
-		ReorderBufferSerializeChange(rb, txn, fd, change);
+		ReorderBufferSerializeChange(rb, txn, file, change);
+
+		/* the spilled changes have to be restorable up to here */
+		if (txn->final_lsn < change->lsn)
+			txn->final_lsn = change->lsn;
+
 		dlist_delete(&change->node);
 		ReorderBufferReturnChange(rb, change);
 
@@ -2050,8 +2384,19 @@ ReorderBufferSerializeTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
 	Assert(dlist_is_empty(&txn->changes));
 	txn->nentries_mem = 0;
 
-	if (fd != -1)
-		CloseTransientFile(fd);
+	if (file != NULL)
+	{
+		txn->serialized = true;
+
+		if (FreeFile(file) != 0)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not write to file \"%s\": %m",
+							path)));
+	}
+
+	if (filebuf != NULL)
+		pfree(filebuf);
 }
 
 /*
@@ -2059,7 +2404,7 @@ ReorderBufferSerializeTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
  */
 static void
 ReorderBufferSerializeChange(ReorderBuffer *rb, ReorderBufferTXN *txn,
-							 int fd, ReorderBufferChange *change)
+							 FILE *file, ReorderBufferChange *change)
 {
 	ReorderBufferDiskChange *ondisk;
 	Size		sz = sizeof(ReorderBufferDiskChange);
@@ -2162,9 +2507,9 @@ ReorderBufferSerializeChange(ReorderBuffer *rb, ReorderBufferTXN *txn,
 
 	ondisk->size = sz;
 
-	if (write(fd, rb->outbuf, ondisk->size) != ondisk->size)
+	if (fwrite(rb->outbuf, 1, ondisk->size, file) != ondisk->size)
 	{
-		CloseTransientFile(fd);
+		FreeFile(file);
 		ereport(ERROR,
 				(errcode_for_file_access(),
 				 errmsg("could not write to data file for XID %u: %m",
@@ -2384,8 +2729,11 @@ ReorderBufferRestoreChange(ReorderBuffer *rb, ReorderBufferTXN *txn,
 			break;
 	}
 
+	change->txn = txn;
 	dlist_push_tail(&txn->changes, &change->node);
 	txn->nentries_mem++;
+
+	ReorderBufferChangeMemoryUpdate(rb, change, true);
 }
 
 /*
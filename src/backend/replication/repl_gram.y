@@ -72,6 +72,8 @@ Node *replication_parse_result;
 %token K_MAX_RATE
 %token K_WAL
 %token K_TABLESPACE_MAP
+%token K_COMPRESS
+%token K_INCREMENTAL
 %token K_TIMELINE
 %token K_PHYSICAL
 %token K_LOGICAL
@@ -178,6 +180,16 @@ base_backup_opt:
 				  $$ = makeDefElem("tablespace_map",
 								   (Node *)makeInteger(TRUE));
 				}
+			| K_COMPRESS UCONST
+				{
+				  $$ = makeDefElem("compress",
+								   (Node *)makeInteger($2));
+				}
+			| K_INCREMENTAL SCONST
+				{
+				  $$ = makeDefElem("incremental",
+								   (Node *)makeString($2));
+				}
 			;
 
 create_replication_slot:
@@ -35,6 +35,13 @@
  * take some time. Once caught up, the current highest priority standby
  * will release waiters from the queue.
  *
+ * synchronous_standby_names can also ask for several synchronous standbys,
+ * either "FIRST num (list)", meaning the num highest priority standbys
+ * that are connected, or "ANY num (list)", meaning any num of the listed
+ * standbys (quorum commit).  Waiters are released up to the oldest position
+ * confirmed by all the chosen standbys in the former case, and up to the
+ * num'th newest position of all the listed standbys in the latter.
+ *
  * Portions Copyright (c) 2010-2015, PostgreSQL Global Development Group
  *
  * IDENTIFICATION
@@ -44,10 +51,13 @@
  */
 #include "postgres.h"
 
+#include <ctype.h>
 #include <unistd.h>
 
 #include "access/xact.h"
 #include "miscadmin.h"
+#include "parser/scansup.h"
+#include "pgstat.h"
 #include "replication/syncrep.h"
 #include "replication/walsender.h"
 #include "replication/walsender_private.h"
@@ -55,11 +65,15 @@
 #include "storage/proc.h"
 #include "tcop/tcopprot.h"
 #include "utils/builtins.h"
+#include "utils/memutils.h"
 #include "utils/ps_status.h"
 
 /* User-settable parameters for sync rep */
 char	   *SyncRepStandbyNames;
 
+/* Parsed form of SyncRepStandbyNames, or NULL if it is empty */
+SyncRepConfigData *SyncRepConfig = NULL;
+
 #define SyncStandbysDefined() \
 	(SyncRepStandbyNames != NULL && SyncRepStandbyNames[0] != '\0')
 
@@ -67,11 +81,25 @@ static bool announce_next_takeover = true;
 
 static int	SyncRepWaitMode = SYNC_REP_NO_WAIT;
 
+/*
+ * Latches of the backends released by SyncRepWakeQueue(), which are set
+ * only after SyncRepLock has been released, so that the woken backends
+ * don't immediately block on the lock.  Allocated on first use, with room
+ * for MaxBackends entries.
+ */
+static Latch **wakeLatches = NULL;
+static int	numWakeLatches = 0;
+
 static void SyncRepQueueInsert(int mode);
 static void SyncRepCancelWait(void);
 static int	SyncRepWakeQueue(bool all, int mode);
+static void SyncRepPrepareWakeLatches(void);
+static void SyncRepSetWakeLatches(void);
 
+static bool SyncRepGetSyncRecPtr(XLogRecPtr *writePtr,
+					 XLogRecPtr *flushPtr, bool *am_sync);
 static int	SyncRepGetStandbyPriority(void);
+static int	cmp_lsn_desc(const void *a, const void *b);
 
 #ifdef USE_ASSERT_CHECKING
 static bool SyncRepQueueIsOrderedByLSN(int mode);
@@ -236,7 +264,9 @@ SyncRepWaitForLSN(XLogRecPtr XactCommitLSN)
 		 * Wait on latch.  Any condition that should wake us up will set the
 		 * latch, so no need for timeout.
 		 */
+		pgstat_report_wait_start(WAIT_EVENT_SYNC_REP);
 		WaitLatch(MyLatch, WL_LATCH_SET | WL_POSTMASTER_DEATH, -1);
+		pgstat_report_wait_end();
 	}
 
 	/*
@@ -349,23 +379,37 @@ SyncRepInitConfig(void)
 }
 
 /*
- * Find the WAL sender servicing the synchronous standby with the lowest
- * priority value, or NULL if no synchronous standby is connected. If there
- * are multiple standbys with the same lowest priority value, the first one
- * found is selected. The caller must hold SyncRepLock.
+ * Find the WAL senders servicing the standbys that are currently
+ * synchronous, and store their indexes in WalSndCtl->walsnds in
+ * 'standbys', which must have room for max_wal_senders entries.  Returns
+ * the number of entries stored.
+ *
+ * With FIRST, these are the num_sync standbys with the lowest priority
+ * values, fewer if not that many are connected; standbys with equal
+ * priority values are taken in the order they are found.  With ANY, all
+ * the listed standbys that are connected are candidates for the quorum and
+ * returned.  Only streaming standbys with a valid flush position count.
+ *
+ * If 'am_sync' is not NULL, *am_sync is set to whether our own WAL sender
+ * is among them.  The caller must hold SyncRepLock.
  */
-WalSnd *
-SyncRepGetSynchronousStandby(void)
+int
+SyncRepGetSyncStandbys(int *standbys, bool *am_sync)
 {
-	WalSnd	   *result = NULL;
-	int			result_priority = 0;
+	int			num_standbys = 0;
 	int			i;
 
+	if (am_sync)
+		*am_sync = false;
+
+	if (SyncRepConfig == NULL)
+		return 0;
+
 	for (i = 0; i < max_wal_senders; i++)
 	{
 		/* Use volatile pointer to prevent code rearrangement */
 		volatile WalSnd *walsnd = &WalSndCtl->walsnds[i];
-		int			this_priority;
+		XLogRecPtr	flush;
 
 		/* Must be active */
 		if (walsnd->pid == 0)
@@ -376,44 +420,159 @@ SyncRepGetSynchronousStandby(void)
 			continue;
 
 		/* Must be synchronous */
-		this_priority = walsnd->sync_standby_priority;
-		if (this_priority == 0)
-			continue;
-
-		/* Must have a lower priority value than any previous ones */
-		if (result != NULL && result_priority <= this_priority)
+		if (walsnd->sync_standby_priority == 0)
 			continue;
 
 		/* Must have a valid flush position */
-		if (XLogRecPtrIsInvalid(walsnd->flush))
+		SpinLockAcquire(&walsnd->mutex);
+		flush = walsnd->flush;
+		SpinLockRelease(&walsnd->mutex);
+		if (XLogRecPtrIsInvalid(flush))
 			continue;
 
-		result = (WalSnd *) walsnd;
-		result_priority = this_priority;
+		standbys[num_standbys++] = i;
+	}
 
-		/*
-		 * If priority is equal to 1, there cannot be any other WAL senders
-		 * with a lower priority, so we're done.
-		 */
-		if (this_priority == 1)
-			return result;
+	/*
+	 * In priority mode, keep only the num_sync standbys with the lowest
+	 * priority values.  There are few WAL senders, so a simple selection
+	 * sort does fine; it keeps standbys of equal priority in array order.
+	 */
+	if (SyncRepConfig->syncrep_method == SYNC_REP_PRIORITY)
+	{
+		int			nkeep = Min(num_standbys, SyncRepConfig->num_sync);
+
+		for (i = 0; i < nkeep; i++)
+		{
+			int			best = i;
+			int			j;
+
+			for (j = i + 1; j < num_standbys; j++)
+			{
+				if (WalSndCtl->walsnds[standbys[j]].sync_standby_priority <
+					WalSndCtl->walsnds[standbys[best]].sync_standby_priority)
+					best = j;
+			}
+			if (best != i)
+			{
+				int			tmp = standbys[best];
+
+				memmove(&standbys[i + 1], &standbys[i],
+						(best - i) * sizeof(int));
+				standbys[i] = tmp;
+			}
+		}
+		num_standbys = nkeep;
 	}
 
-	return result;
+	if (am_sync)
+	{
+		for (i = 0; i < num_standbys; i++)
+		{
+			if (&WalSndCtl->walsnds[standbys[i]] == MyWalSnd)
+			{
+				*am_sync = true;
+				break;
+			}
+		}
+	}
+
+	return num_standbys;
 }
 
 /*
- * Update the LSNs on each queue based upon our latest state. This
- * implements a simple policy of first-valid-standby-releases-waiter.
+ * Calculate the write and flush positions that have been confirmed by
+ * enough synchronous standbys to release waiters up to them.  Returns false
+ * if not enough synchronous standbys are connected, or if our WAL sender is
+ * not one of them, in which case *am_sync is false and it's up to another
+ * WAL sender to release the waiters.  The caller must hold SyncRepLock.
+ */
+static bool
+SyncRepGetSyncRecPtr(XLogRecPtr *writePtr, XLogRecPtr *flushPtr,
+					 bool *am_sync)
+{
+	int		   *standbys;
+	XLogRecPtr *writes;
+	XLogRecPtr *flushes;
+	int			num_standbys;
+	int			i;
+
+	standbys = (int *) palloc(max_wal_senders * sizeof(int));
+	num_standbys = SyncRepGetSyncStandbys(standbys, am_sync);
+
+	if (!*am_sync || num_standbys < SyncRepConfig->num_sync)
+	{
+		pfree(standbys);
+		return false;
+	}
+
+	writes = (XLogRecPtr *) palloc(num_standbys * sizeof(XLogRecPtr));
+	flushes = (XLogRecPtr *) palloc(num_standbys * sizeof(XLogRecPtr));
+	for (i = 0; i < num_standbys; i++)
+	{
+		volatile WalSnd *walsnd = &WalSndCtl->walsnds[standbys[i]];
+
+		SpinLockAcquire(&walsnd->mutex);
+		writes[i] = walsnd->write;
+		flushes[i] = walsnd->flush;
+		SpinLockRelease(&walsnd->mutex);
+	}
+
+	/*
+	 * A position has been confirmed by num_sync of the standbys when it is
+	 * no later than the num_sync'th newest one of their positions.  In
+	 * priority mode we have exactly num_sync standbys, so that's the oldest.
+	 */
+	qsort(writes, num_standbys, sizeof(XLogRecPtr), cmp_lsn_desc);
+	qsort(flushes, num_standbys, sizeof(XLogRecPtr), cmp_lsn_desc);
+	*writePtr = writes[SyncRepConfig->num_sync - 1];
+	*flushPtr = flushes[SyncRepConfig->num_sync - 1];
+
+	pfree(standbys);
+	pfree(writes);
+	pfree(flushes);
+
+	return true;
+}
+
+/*
+ * qsort comparator to sort XLogRecPtrs in descending order
+ */
+static int
+cmp_lsn_desc(const void *a, const void *b)
+{
+	XLogRecPtr	lsn1 = *((const XLogRecPtr *) a);
+	XLogRecPtr	lsn2 = *((const XLogRecPtr *) b);
+
+	if (lsn1 > lsn2)
+		return -1;
+	else if (lsn1 == lsn2)
+		return 0;
+	else
+		return 1;
+}
+
+/*
+ * Update the LSNs on each queue based upon our latest state, if we are one
+ * of the synchronous standbys, and wake the backends waiting for them.
  *
- * Other policies are possible, which would change what we do here and what
- * perhaps also which information we store as well.
+ * The positions are computed under a shared lock, because most replies
+ * don't advance them: they come from standbys that are not synchronous,
+ * or that are ahead of other synchronous standbys that the release has to
+ * wait for.  Only if there's something to release do we take the lock in
+ * exclusive mode.  The positions computed were confirmed by enough
+ * standbys at the time, so it's fine if the set of synchronous standbys
+ * changed in between.
  */
 void
 SyncRepReleaseWaiters(void)
 {
 	volatile WalSndCtlData *walsndctl = WalSndCtl;
-	WalSnd	   *syncWalSnd;
+	XLogRecPtr	writePtr = InvalidXLogRecPtr;
+	XLogRecPtr	flushPtr = InvalidXLogRecPtr;
+	bool		got_recptr;
+	bool		am_sync;
+	bool		advance;
 	int			numwrite = 0;
 	int			numflush = 0;
 
@@ -429,56 +588,70 @@ SyncRepReleaseWaiters(void)
 		return;
 
 	/*
-	 * We're a potential sync standby. Release waiters if we are the highest
-	 * priority standby.
+	 * We're a potential sync standby. Find out whether we are one of the
+	 * synchronous standbys, and how far they have all confirmed.
 	 */
-	LWLockAcquire(SyncRepLock, LW_EXCLUSIVE);
-	syncWalSnd = SyncRepGetSynchronousStandby();
-
-	/* We should have found ourselves at least */
-	Assert(syncWalSnd != NULL);
+	LWLockAcquire(SyncRepLock, LW_SHARED);
+	got_recptr = SyncRepGetSyncRecPtr(&writePtr, &flushPtr, &am_sync);
+	advance = got_recptr &&
+		(walsndctl->lsn[SYNC_REP_WAIT_WRITE] < writePtr ||
+		 walsndctl->lsn[SYNC_REP_WAIT_FLUSH] < flushPtr);
+	LWLockRelease(SyncRepLock);
 
 	/*
-	 * If we aren't managing the highest priority standby then just leave.
+	 * If we aren't managing one of the synchronous standbys then just leave.
 	 */
-	if (syncWalSnd != MyWalSnd)
+	if (!am_sync)
 	{
-		LWLockRelease(SyncRepLock);
 		announce_next_takeover = true;
 		return;
 	}
 
-	/*
-	 * Set the lsn first so that when we wake backends they will release up to
-	 * this location.
-	 */
-	if (walsndctl->lsn[SYNC_REP_WAIT_WRITE] < MyWalSnd->write)
-	{
-		walsndctl->lsn[SYNC_REP_WAIT_WRITE] = MyWalSnd->write;
-		numwrite = SyncRepWakeQueue(false, SYNC_REP_WAIT_WRITE);
-	}
-	if (walsndctl->lsn[SYNC_REP_WAIT_FLUSH] < MyWalSnd->flush)
+	if (advance)
 	{
-		walsndctl->lsn[SYNC_REP_WAIT_FLUSH] = MyWalSnd->flush;
-		numflush = SyncRepWakeQueue(false, SYNC_REP_WAIT_FLUSH);
-	}
+		SyncRepPrepareWakeLatches();
 
-	LWLockRelease(SyncRepLock);
+		LWLockAcquire(SyncRepLock, LW_EXCLUSIVE);
 
-	elog(DEBUG3, "released %d procs up to write %X/%X, %d procs up to flush %X/%X",
-		 numwrite, (uint32) (MyWalSnd->write >> 32), (uint32) MyWalSnd->write,
-	   numflush, (uint32) (MyWalSnd->flush >> 32), (uint32) MyWalSnd->flush);
+		/*
+		 * Set the lsn first so that when we wake backends they will release
+		 * up to this location.
+		 */
+		if (walsndctl->lsn[SYNC_REP_WAIT_WRITE] < writePtr)
+		{
+			walsndctl->lsn[SYNC_REP_WAIT_WRITE] = writePtr;
+			numwrite = SyncRepWakeQueue(false, SYNC_REP_WAIT_WRITE);
+		}
+		if (walsndctl->lsn[SYNC_REP_WAIT_FLUSH] < flushPtr)
+		{
+			walsndctl->lsn[SYNC_REP_WAIT_FLUSH] = flushPtr;
+			numflush = SyncRepWakeQueue(false, SYNC_REP_WAIT_FLUSH);
+		}
+
+		LWLockRelease(SyncRepLock);
+
+		SyncRepSetWakeLatches();
+
+		elog(DEBUG3, "released %d procs up to write %X/%X, %d procs up to flush %X/%X",
+			 numwrite, (uint32) (writePtr >> 32), (uint32) writePtr,
+			 numflush, (uint32) (flushPtr >> 32), (uint32) flushPtr);
+	}
 
 	/*
-	 * If we are managing the highest priority standby, though we weren't
-	 * prior to this, then announce we are now the sync standby.
+	 * If we are managing a synchronous standby, though we weren't prior to
+	 * this, then announce we are now a sync standby.
 	 */
 	if (announce_next_takeover)
 	{
 		announce_next_takeover = false;
-		ereport(LOG,
-				(errmsg("standby \"%s\" is now the synchronous standby with priority %u",
-						application_name, MyWalSnd->sync_standby_priority)));
+		if (SyncRepConfig->syncrep_method == SYNC_REP_PRIORITY)
+			ereport(LOG,
+					(errmsg("standby \"%s\" is now a synchronous standby with priority %u",
+							application_name, MyWalSnd->sync_standby_priority)));
+		else
+			ereport(LOG,
+					(errmsg("standby \"%s\" is now a candidate for quorum synchronous standby",
+							application_name)));
 	}
 }
 
@@ -493,10 +666,8 @@ SyncRepReleaseWaiters(void)
 static int
 SyncRepGetStandbyPriority(void)
 {
-	char	   *rawstring;
-	List	   *elemlist;
-	ListCell   *l;
-	int			priority = 0;
+	const char *standby_name;
+	int			priority;
 	bool		found = false;
 
 	/*
@@ -506,36 +677,21 @@ SyncRepGetStandbyPriority(void)
 	if (am_cascading_walsender)
 		return 0;
 
-	/* Need a modifiable copy of string */
-	rawstring = pstrdup(SyncRepStandbyNames);
-
-	/* Parse string into list of identifiers */
-	if (!SplitIdentifierString(rawstring, ',', &elemlist))
-	{
-		/* syntax error in list */
-		pfree(rawstring);
-		list_free(elemlist);
-		/* GUC machinery will have already complained - no need to do again */
+	if (!SyncStandbysDefined() || SyncRepConfig == NULL)
 		return 0;
-	}
 
-	foreach(l, elemlist)
+	standby_name = SyncRepConfig->member_names;
+	for (priority = 1; priority <= SyncRepConfig->nmembers; priority++)
 	{
-		char	   *standby_name = (char *) lfirst(l);
-
-		priority++;
-
 		if (pg_strcasecmp(standby_name, application_name) == 0 ||
-			pg_strcasecmp(standby_name, "*") == 0)
+			strcmp(standby_name, "*") == 0)
 		{
 			found = true;
 			break;
 		}
+		standby_name += strlen(standby_name) + 1;
 	}
 
-	pfree(rawstring);
-	list_free(elemlist);
-
 	return (found ? priority : 0);
 }
 
@@ -591,9 +747,16 @@ SyncRepWakeQueue(bool all, int mode)
 		SHMQueueDelete(&(thisproc->syncRepLinks));
 
 		/*
-		 * Wake only when we have set state and removed from queue.
+		 * Wake only when we have set state and removed from queue.  The
+		 * latch is normally set by SyncRepSetWakeLatches() once the caller
+		 * has released SyncRepLock.  It doesn't matter if the backend
+		 * notices the state change and goes on before that; it just gets a
+		 * spurious wakeup later.
 		 */
-		SetLatch(&(thisproc->procLatch));
+		if (wakeLatches != NULL && numWakeLatches < MaxBackends)
+			wakeLatches[numWakeLatches++] = &(thisproc->procLatch);
+		else
+			SetLatch(&(thisproc->procLatch));
 
 		numprocs++;
 	}
@@ -601,6 +764,33 @@ SyncRepWakeQueue(bool all, int mode)
 	return numprocs;
 }
 
+/*
+ * Make sure wakeLatches is allocated.  Must be called before acquiring
+ * SyncRepLock, to avoid running out of memory while holding it.
+ */
+static void
+SyncRepPrepareWakeLatches(void)
+{
+	if (wakeLatches == NULL)
+		wakeLatches = (Latch **) MemoryContextAlloc(TopMemoryContext,
+											  MaxBackends * sizeof(Latch *));
+	numWakeLatches = 0;
+}
+
+/*
+ * Set the latches collected by SyncRepWakeQueue().  Called after releasing
+ * SyncRepLock.
+ */
+static void
+SyncRepSetWakeLatches(void)
+{
+	int			i;
+
+	for (i = 0; i < numWakeLatches; i++)
+		SetLatch(wakeLatches[i]);
+	numWakeLatches = 0;
+}
+
 /*
  * The checkpointer calls this as needed to update the shared
  * sync_standbys_defined flag, so that backends don't remain permanently wedged
@@ -615,6 +805,8 @@ SyncRepUpdateSyncStandbysDefined(void)
 
 	if (sync_standbys_defined != WalSndCtl->sync_standbys_defined)
 	{
+		SyncRepPrepareWakeLatches();
+
 		LWLockAcquire(SyncRepLock, LW_EXCLUSIVE);
 
 		/*
@@ -640,6 +832,8 @@ SyncRepUpdateSyncStandbysDefined(void)
 		WalSndCtl->sync_standbys_defined = sync_standbys_defined;
 
 		LWLockRelease(SyncRepLock);
+
+		SyncRepSetWakeLatches();
 	}
 }
 
@@ -684,14 +878,97 @@ SyncRepQueueIsOrderedByLSN(int mode)
  * ===========================================================
  */
 
-bool
-check_synchronous_standby_names(char **newval, void **extra, GucSource source)
+/*
+ * Parse synchronous_standby_names, which is either a plain list of standby
+ * names, meaning one synchronous standby chosen by priority, or
+ *
+ *		[FIRST | ANY] num (standby_name [, ...])
+ *
+ * Returns a palloc'd SyncRepConfigData, or NULL after setting the GUC error
+ * detail.
+ */
+static SyncRepConfigData *
+SyncRepParseStandbyNames(const char *value)
 {
+	const char *p = value;
+	const char *listptr = value;
 	char	   *rawstring;
 	List	   *elemlist;
+	ListCell   *l;
+	uint8		syncrep_method = SYNC_REP_PRIORITY;
+	long		num_sync = 1;
+	bool		has_num = false;
+	SyncRepConfigData *config;
+	Size		size;
+	char	   *ptr;
+
+	/*
+	 * Check for the "[FIRST | ANY] num (" prefix.  A value that doesn't
+	 * start like that is a plain list, even if a standby name happens to be
+	 * FIRST or ANY.
+	 */
+	while (scanner_isspace(*p))
+		p++;
+	if ((pg_strncasecmp(p, "first", 5) == 0 && scanner_isspace(p[5])) ||
+		(pg_strncasecmp(p, "any", 3) == 0 && scanner_isspace(p[3])))
+	{
+		const char *q = p + (pg_strncasecmp(p, "any", 3) == 0 ? 3 : 5);
 
-	/* Need a modifiable copy of string */
-	rawstring = pstrdup(*newval);
+		while (scanner_isspace(*q))
+			q++;
+		if (isdigit((unsigned char) *q))
+		{
+			if (pg_strncasecmp(p, "any", 3) == 0)
+				syncrep_method = SYNC_REP_QUORUM;
+			p = q;
+		}
+	}
+	if (isdigit((unsigned char) *p))
+	{
+		const char *q = p;
+
+		while (isdigit((unsigned char) *q))
+			q++;
+		while (scanner_isspace(*q))
+			q++;
+		if (*q == '(')
+		{
+			errno = 0;
+			num_sync = strtol(p, NULL, 10);
+			if (errno != 0 || num_sync <= 0 || num_sync > INT_MAX)
+			{
+				GUC_check_errcode(ERRCODE_INVALID_PARAMETER_VALUE);
+				GUC_check_errdetail("Number of synchronous standbys must be greater than zero.");
+				return NULL;
+			}
+			has_num = true;
+			listptr = q + 1;
+		}
+	}
+	if (!has_num && syncrep_method == SYNC_REP_QUORUM)
+	{
+		GUC_check_errdetail("ANY must be followed by the number of synchronous standbys and a parenthesized list of standby names.");
+		return NULL;
+	}
+
+	/* Need a modifiable copy of the list */
+	rawstring = pstrdup(listptr);
+
+	if (has_num)
+	{
+		/* The list must end with the closing parenthesis */
+		char	   *end = rawstring + strlen(rawstring);
+
+		while (end > rawstring && scanner_isspace(end[-1]))
+			end--;
+		if (end == rawstring || end[-1] != ')')
+		{
+			GUC_check_errdetail("Missing closing parenthesis after list of standby names.");
+			pfree(rawstring);
+			return NULL;
+		}
+		end[-1] = '\0';
+	}
 
 	/* Parse string into list of identifiers */
 	if (!SplitIdentifierString(rawstring, ',', &elemlist))
@@ -700,9 +977,48 @@ check_synchronous_standby_names(char **newval, void **extra, GucSource source)
 		GUC_check_errdetail("List syntax is invalid.");
 		pfree(rawstring);
 		list_free(elemlist);
-		return false;
+		return NULL;
+	}
+
+	/* Flatten it into a single chunk, see SyncRepConfigData */
+	size = offsetof(SyncRepConfigData, member_names);
+	foreach(l, elemlist)
+		size += strlen((char *) lfirst(l)) + 1;
+
+	config = (SyncRepConfigData *) palloc(size);
+	config->config_size = size;
+	config->num_sync = (int) num_sync;
+	config->syncrep_method = syncrep_method;
+	config->nmembers = list_length(elemlist);
+	ptr = config->member_names;
+	foreach(l, elemlist)
+	{
+		strcpy(ptr, (char *) lfirst(l));
+		ptr += strlen(ptr) + 1;
+	}
+
+	pfree(rawstring);
+	list_free(elemlist);
+
+	return config;
+}
+
+bool
+check_synchronous_standby_names(char **newval, void **extra, GucSource source)
+{
+	SyncRepConfigData *config;
+
+	/* An empty value means no synchronous replication */
+	if (*newval == NULL || (*newval)[0] == '\0')
+	{
+		*extra = NULL;
+		return true;
 	}
 
+	config = SyncRepParseStandbyNames(*newval);
+	if (config == NULL)
+		return false;
+
 	/*
 	 * Any additional validation of standby names should go here.
 	 *
@@ -711,12 +1027,24 @@ check_synchronous_standby_names(char **newval, void **extra, GucSource source)
 	 * yet correctly set.
 	 */
 
-	pfree(rawstring);
-	list_free(elemlist);
+	*extra = malloc(config->config_size);
+	if (*extra == NULL)
+	{
+		pfree(config);
+		return false;
+	}
+	memcpy(*extra, config, config->config_size);
+	pfree(config);
 
 	return true;
 }
 
+void
+assign_synchronous_standby_names(const char *newval, void *extra)
+{
+	SyncRepConfig = (SyncRepConfigData *) extra;
+}
+
 void
 assign_synchronous_commit(int newval, void *extra)
 {
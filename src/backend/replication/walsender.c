@@ -55,6 +55,7 @@
 #include "libpq/pqformat.h"
 #include "miscadmin.h"
 #include "nodes/replnodes.h"
+#include "pgstat.h"
 #include "replication/basebackup.h"
 #include "replication/decode.h"
 #include "replication/logical.h"
@@ -81,15 +82,17 @@
 #include "utils/timestamp.h"
 
 /*
- * Maximum data payload in a WAL data message.  Must be >= XLOG_BLCKSZ.
+ * Minimum and maximum data payload in a WAL data message.  Must be >=
+ * XLOG_BLCKSZ.
  *
- * We don't have a good idea of what a good value would be; there's some
- * overhead per message in both walsender and walreceiver, but on the other
- * hand sending large batches makes walsender less responsive to signals
- * because signals are checked only between messages.  128kB (with
- * default 8k blocks) seems like a reasonable guess for now.
+ * There's some overhead per message in both walsender and walreceiver, but
+ * on the other hand sending large batches makes walsender less responsive to
+ * signals because signals are checked only between messages.  So we start
+ * with 128kB (with default 8k blocks) and double the size for each message
+ * that had to be cut short, up to 1MB, until the standby has caught up.
  */
-#define MAX_SEND_SIZE (XLOG_BLCKSZ * 16)
+#define MIN_SEND_SIZE (XLOG_BLCKSZ * 16)
+#define MAX_SEND_SIZE (XLOG_BLCKSZ * 128)
 
 /* Array of WalSnds in shared memory */
 WalSndCtlData *WalSndCtl = NULL;
@@ -168,6 +171,9 @@ static bool streamingDoneReceiving;
 /* Are we there yet? */
 static bool WalSndCaughtUp = false;
 
+/* Payload size of the next WAL data message, see MAX_SEND_SIZE */
+static Size sendSize = MIN_SEND_SIZE;
+
 /* Flags set by signal handlers for later service in main loop */
 static volatile sig_atomic_t got_SIGHUP = false;
 static volatile sig_atomic_t walsender_ready_to_stop = false;
@@ -1120,8 +1126,10 @@ WalSndWriteData(LogicalDecodingContext *ctx, XLogRecPtr lsn, TransactionId xid,
 			WL_SOCKET_WRITEABLE | WL_SOCKET_READABLE | WL_TIMEOUT;
 
 		/* Sleep until something happens or we time out */
+		pgstat_report_wait_start(WAIT_EVENT_WAL_SENDER_WRITE_DATA);
 		WaitLatchOrSocket(MyLatch, wakeEvents,
 						  MyProcPort->sock, sleeptime);
+		pgstat_report_wait_end();
 	}
 
 	/* reactivate latch so WalSndLoop knows to continue */
@@ -1246,8 +1254,10 @@ WalSndWaitForWal(XLogRecPtr loc)
 			wakeEvents |= WL_SOCKET_WRITEABLE;
 
 		/* Sleep until something happens or we time out */
+		pgstat_report_wait_start(WAIT_EVENT_WAL_SENDER_WAIT_WAL);
 		WaitLatchOrSocket(MyLatch, wakeEvents,
 						  MyProcPort->sock, sleeptime);
+		pgstat_report_wait_end();
 	}
 
 	/* reactivate latch so WalSndLoop knows to continue */
@@ -1900,8 +1910,10 @@ WalSndLoop(WalSndSendDataCallback send_data)
 				wakeEvents |= WL_SOCKET_WRITEABLE;
 
 			/* Sleep until something happens or we time out */
+			pgstat_report_wait_start(WAIT_EVENT_WAL_SENDER_MAIN);
 			WaitLatchOrSocket(MyLatch, wakeEvents,
 							  MyProcPort->sock, sleeptime);
+			pgstat_report_wait_end();
 		}
 	}
 	return;
@@ -2101,7 +2113,9 @@ retry:
 		else
 			segbytes = nbytes;
 
+		pgstat_report_wait_start(WAIT_EVENT_WAL_READ);
 		readbytes = read(sendFile, p, segbytes);
+		pgstat_report_wait_end();
 		if (readbytes <= 0)
 		{
 			ereport(ERROR,
@@ -2159,7 +2173,7 @@ retry:
 /*
  * Send out the WAL in its normal physical/stored form.
  *
- * Read up to MAX_SEND_SIZE bytes of WAL that's been flushed to disk,
+ * Read up to sendSize bytes of WAL that's been flushed to disk,
  * but not yet sent to the client, and buffer it in the libpq output
  * buffer.
  *
@@ -2173,6 +2187,7 @@ XLogSendPhysical(void)
 	XLogRecPtr	startptr;
 	XLogRecPtr	endptr;
 	Size		nbytes;
+	Size		nbuffered;
 
 	if (streamingDoneSending)
 	{
@@ -2311,8 +2326,8 @@ XLogSendPhysical(void)
 
 	/*
 	 * Figure out how much to send in one message. If there's no more than
-	 * MAX_SEND_SIZE bytes to send, send everything. Otherwise send
-	 * MAX_SEND_SIZE bytes, but round back to logfile or page boundary.
+	 * sendSize bytes to send, send everything. Otherwise send sendSize
+	 * bytes, but round back to logfile or page boundary.
 	 *
 	 * The rounding is not only for performance reasons. Walreceiver relies on
 	 * the fact that we never split a WAL record across two messages. Since a
@@ -2322,7 +2337,7 @@ XLogSendPhysical(void)
 	 */
 	startptr = sentPtr;
 	endptr = startptr;
-	endptr += MAX_SEND_SIZE;
+	endptr += sendSize;
 
 	/* if we went beyond SendRqstPtr, back off */
 	if (SendRqstPtr <= endptr)
@@ -2332,12 +2347,15 @@ XLogSendPhysical(void)
 			WalSndCaughtUp = false;
 		else
 			WalSndCaughtUp = true;
+		sendSize = MIN_SEND_SIZE;
 	}
 	else
 	{
 		/* round down to page boundary. */
 		endptr -= (endptr % XLOG_BLCKSZ);
 		WalSndCaughtUp = false;
+		/* we're behind, so send more at a time from now on */
+		sendSize = Min(sendSize * 2, MAX_SEND_SIZE);
 	}
 
 	nbytes = endptr - startptr;
@@ -2355,10 +2373,19 @@ XLogSendPhysical(void)
 
 	/*
 	 * Read the log directly into the output buffer to avoid extra memcpy
-	 * calls.
+	 * calls.  On a primary streaming the current timeline, recent WAL is
+	 * usually still in the WAL buffers, so copy what we can from there and
+	 * read only the rest from the segment files.
 	 */
 	enlargeStringInfo(&output_message, nbytes);
-	XLogRead(&output_message.data[output_message.len], startptr, nbytes);
+	if (!am_cascading_walsender && !sendTimeLineIsHistoric)
+		nbuffered = XLogReadFromBuffers(&output_message.data[output_message.len],
+										startptr, nbytes);
+	else
+		nbuffered = 0;
+	if (nbuffered < nbytes)
+		XLogRead(&output_message.data[output_message.len + nbuffered],
+				 startptr + nbuffered, nbytes - nbuffered);
 	output_message.len += nbytes;
 	output_message.data[output_message.len] = '\0';
 
@@ -2732,8 +2759,10 @@ pg_stat_get_wal_senders(PG_FUNCTION_ARGS)
 	Tuplestorestate *tupstore;
 	MemoryContext per_query_ctx;
 	MemoryContext oldcontext;
-	WalSnd	   *sync_standby;
+	int		   *sync_standbys;
+	int			num_standbys;
 	int			i;
+	int			j;
 
 	/* check to see if caller supports us returning a tuplestore */
 	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
@@ -2761,10 +2790,11 @@ pg_stat_get_wal_senders(PG_FUNCTION_ARGS)
 	MemoryContextSwitchTo(oldcontext);
 
 	/*
-	 * Get the currently active synchronous standby.
+	 * Get the currently active synchronous standbys.
 	 */
+	sync_standbys = (int *) palloc(max_wal_senders * sizeof(int));
 	LWLockAcquire(SyncRepLock, LW_SHARED);
-	sync_standby = SyncRepGetSynchronousStandby();
+	num_standbys = SyncRepGetSyncStandbys(sync_standbys, NULL);
 	LWLockRelease(SyncRepLock);
 
 	for (i = 0; i < max_wal_senders; i++)
@@ -2776,6 +2806,7 @@ pg_stat_get_wal_senders(PG_FUNCTION_ARGS)
 		XLogRecPtr	flush;
 		XLogRecPtr	apply;
 		int			priority;
+		bool		is_sync_standby;
 		WalSndState state;
 		Datum		values[PG_STAT_GET_WAL_SENDERS_COLS];
 		bool		nulls[PG_STAT_GET_WAL_SENDERS_COLS];
@@ -2831,11 +2862,25 @@ pg_stat_get_wal_senders(PG_FUNCTION_ARGS)
 
 			/*
 			 * More easily understood version of standby state. This is purely
-			 * informational, not different from priority.
+			 * informational.  With quorum commit, all the listed standbys are
+			 * equally synchronous.
 			 */
+			is_sync_standby = false;
+			for (j = 0; j < num_standbys; j++)
+			{
+				if (sync_standbys[j] == i)
+				{
+					is_sync_standby = true;
+					break;
+				}
+			}
+
 			if (priority == 0)
 				values[7] = CStringGetTextDatum("async");
-			else if (walsnd == sync_standby)
+			else if (is_sync_standby &&
+					 SyncRepConfig->syncrep_method == SYNC_REP_QUORUM)
+				values[7] = CStringGetTextDatum("quorum");
+			else if (is_sync_standby)
 				values[7] = CStringGetTextDatum("sync");
 			else
 				values[7] = CStringGetTextDatum("potential");
@@ -14,12 +14,26 @@
  */
 #include "postgres.h"
 
+#include "port/pg_numa.h"
+#include "postmaster/postmaster.h"
 #include "storage/bufmgr.h"
 #include "storage/buf_internals.h"
 
 
 BufferDescPadded *BufferDescriptors;
 char	   *BufferBlocks;
+CkptSortItem *CkptBufferIds;
+
+/* GUC variable */
+int			numa_buffers = NUMA_BUFFERS_OFF;
+
+/*
+ * Partitions of the buffer pool are made a multiple of this many buffers,
+ * so that each one covers whole 2MB huge pages of buffer blocks.
+ */
+#define NUMA_PARTITION_ALIGN	Max(1, PG_NUMA_PAGE_SIZE / BLCKSZ)
+
+static int	PlaceBufferPool(int *nodes, int *partitionSize);
 
 
 /*
@@ -52,6 +66,17 @@ char	   *BufferBlocks;
  *		Pins must be released before end of transaction.  For efficiency the
  *		shared refcount isn't increased if an individual backend pins a buffer
  *		multiple times. Check the PrivateRefCount infrastructure in bufmgr.c.
+ *
+ *
+ * NUMA placement:
+ *		With numa_buffers = interleave, the pages of the descriptor and
+ *		block arrays are spread round-robin over all NUMA nodes, so that
+ *		every node sees the same mix of local and remote buffers.  With
+ *		numa_buffers = partition, the buffers are split into one contiguous
+ *		range per node instead, with the memory of each range placed on
+ *		its node, and freelist.c gives each range its own freelist and
+ *		clock sweep.  Either way the placement has to be requested before
+ *		the memory is first touched, which is why it's done here.
  */
 
 
@@ -65,7 +90,18 @@ void
 InitBufferPool(void)
 {
 	bool		foundBufs,
-				foundDescs;
+				foundDescs,
+				foundBufCkpt;
+	int			nodes[PG_NUMA_MAX_NODES];
+	int			numPartitions = 1;
+	int			partitionSize = NBuffers;
+
+	/* the refcount part of the buffer state must be able to count everyone */
+	StaticAssertStmt(MAX_BACKENDS <= BUF_REFCOUNT_MASK,
+					 "MAX_BACKENDS too big for buffer refcount");
+	StaticAssertStmt(BM_MAX_USAGE_COUNT <=
+					 (BUF_USAGECOUNT_MASK >> BUF_USAGECOUNT_SHIFT),
+					 "BM_MAX_USAGE_COUNT too big for buffer usage count");
 
 	/* Align descriptors to a cacheline boundary. */
 	BufferDescriptors = (BufferDescPadded *) CACHELINEALIGN(
@@ -73,9 +109,11 @@ InitBufferPool(void)
 					NBuffers * sizeof(BufferDescPadded) + PG_CACHE_LINE_SIZE,
 														&foundDescs));
 
-	BufferBlocks = (char *)
+	/* Align buffer pool pages for direct I/O, see data_direct_io. */
+	BufferBlocks = (char *) IOALIGN(
 		ShmemInitStruct("Buffer Blocks",
-						NBuffers * (Size) BLCKSZ, &foundBufs);
+						NBuffers * (Size) BLCKSZ + PG_IO_ALIGN_SIZE,
+						&foundBufs));
 
 	if (foundDescs || foundBufs)
 	{
@@ -87,6 +125,9 @@ InitBufferPool(void)
 	{
 		int			i;
 
+		/* Ask for the memory to be placed on NUMA nodes, if configured */
+		numPartitions = PlaceBufferPool(nodes, &partitionSize);
+
 		/*
 		 * Initialize all the buffer headers.
 		 */
@@ -95,12 +136,9 @@ InitBufferPool(void)
 			BufferDesc *buf = GetBufferDescriptor(i);
 
 			CLEAR_BUFFERTAG(buf->tag);
-			buf->flags = 0;
-			buf->usage_count = 0;
-			buf->refcount = 0;
-			buf->wait_backend_pid = 0;
 
-			SpinLockInit(&buf->buf_hdr_lock);
+			pg_atomic_init_u32(&buf->state, 0);
+			buf->wait_backend_pid = 0;
 
 			buf->buf_id = i;
 
@@ -118,8 +156,100 @@ InitBufferPool(void)
 		GetBufferDescriptor(NBuffers - 1)->freeNext = FREENEXT_END_OF_LIST;
 	}
 
+	/*
+	 * Workspace for BufferSync, allocated here so that a checkpoint can't
+	 * fail for lack of memory.
+	 */
+	CkptBufferIds = (CkptSortItem *)
+		ShmemInitStruct("Checkpoint BufferIds",
+						NBuffers * sizeof(CkptSortItem), &foundBufCkpt);
+
 	/* Init other shared buffer-management stuff */
-	StrategyInitialize(!foundDescs);
+	StrategyInitialize(!foundDescs, numPartitions, partitionSize, nodes);
+}
+
+/*
+ * PlaceBufferPool -- apply numa_buffers to the buffer pool's memory
+ *
+ * Returns the number of partitions freelist.c should divide the buffers
+ * into, stores the size of all but the last partition into *partitionSize,
+ * and the NUMA node of each partition into nodes[] (-1 if none).
+ *
+ * Failing to place memory isn't fatal; the server works all the same, just
+ * more slowly.  So we only complain in the log.
+ */
+static int
+PlaceBufferPool(int *nodes, int *partitionSize)
+{
+	int			numNodes;
+	int			numPartitions;
+	int			i;
+
+	*partitionSize = NBuffers;
+	nodes[0] = -1;
+
+	if (numa_buffers == NUMA_BUFFERS_OFF)
+		return 1;
+
+	numNodes = pg_numa_get_nodes(nodes, PG_NUMA_MAX_NODES);
+	if (numNodes < 1)
+	{
+		ereport(LOG,
+				(errmsg("NUMA is not supported on this platform, ignoring numa_buffers")));
+		nodes[0] = -1;
+		return 1;
+	}
+
+	if (numa_buffers == NUMA_BUFFERS_INTERLEAVE || numNodes == 1)
+	{
+		if (!pg_numa_interleave_memory(BufferDescriptors,
+									   NBuffers * sizeof(BufferDescPadded),
+									   nodes, numNodes) ||
+			!pg_numa_interleave_memory(BufferBlocks,
+									   NBuffers * (Size) BLCKSZ,
+									   nodes, numNodes))
+			ereport(LOG,
+					(errmsg("could not interleave shared buffers over NUMA nodes: %m")));
+		nodes[0] = numNodes == 1 ? nodes[0] : -1;
+		return 1;
+	}
+
+	/*
+	 * Split the buffers evenly into one partition per node.  With too few
+	 * buffers to give every node a whole number of huge pages, make fewer
+	 * partitions.
+	 */
+	numPartitions = numNodes;
+	*partitionSize = (int) TYPEALIGN_DOWN(NUMA_PARTITION_ALIGN,
+										  NBuffers / numPartitions);
+	if (*partitionSize == 0)
+	{
+		numPartitions = Max(1, NBuffers / NUMA_PARTITION_ALIGN);
+		*partitionSize = NBuffers / numPartitions;
+	}
+
+	for (i = 0; i < numPartitions; i++)
+	{
+		int			first = i * *partitionSize;
+		int			count;
+
+		if (i == numPartitions - 1)
+			count = NBuffers - first;
+		else
+			count = *partitionSize;
+
+		if (!pg_numa_bind_memory(GetBufferDescriptor(first),
+								 count * sizeof(BufferDescPadded),
+								 nodes[i]) ||
+			!pg_numa_bind_memory(BufferBlocks + first * (Size) BLCKSZ,
+								 count * (Size) BLCKSZ,
+								 nodes[i]))
+			ereport(LOG,
+					(errmsg("could not place shared buffers on NUMA node %d: %m",
+							nodes[i])));
+	}
+
+	return numPartitions;
 }
 
 /*
@@ -138,11 +268,15 @@ BufferShmemSize(void)
 	/* to allow aligning buffer descriptors */
 	size = add_size(size, PG_CACHE_LINE_SIZE);
 
-	/* size of data pages */
+	/* size of data pages, plus alignment padding */
 	size = add_size(size, mul_size(NBuffers, BLCKSZ));
+	size = add_size(size, PG_IO_ALIGN_SIZE);
 
 	/* size of stuff controlled by freelist.c */
 	size = add_size(size, StrategyShmemSize());
 
+	/* size of checkpoint sort array in bufmgr.c */
+	size = add_size(size, mul_size(NBuffers, sizeof(CkptSortItem)));
+
 	return size;
 }
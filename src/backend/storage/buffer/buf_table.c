@@ -3,11 +3,25 @@
  * buf_table.c
  *	  routines for mapping BufferTags to buffer indexes.
  *
- * Note: the routines in this file do no locking of their own.  The caller
- * must hold a suitable lock on the appropriate BufMappingLock, as specified
- * in the comments.  We can't do the locking inside these functions because
- * in most cases the caller needs to adjust the buffer header contents
- * before the lock is released (see notes in README).
+ * The mapping table is a purpose-built open-addressing hash table, with the
+ * tags stored inline, rather than a dynahash table.  It is divided into one
+ * sub-table per BufMappingLock partition.  Each sub-table is an array of
+ * entries searched by linear probing, so a lookup usually touches a single
+ * cache line rather than following a chain of pointers.
+ *
+ * Insertions and deletions are done by the caller holding exclusive lock
+ * on the appropriate BufMappingLock; we can't do the locking inside these
+ * functions because in most cases the caller needs to adjust the buffer
+ * header contents before the lock is released (see notes in README).
+ *
+ * Lookups take no lock at all.  Each sub-table has a change counter, which
+ * writers make odd while they're modifying the sub-table and even again
+ * when they're done.  A lookup that sees the counter odd, or changed by the
+ * time it's done, starts over; if that keeps happening, it falls back to
+ * taking the BufMappingLock in shared mode.  Note that a lock-free lookup
+ * only tells the caller where the page was at some instant: unless it holds
+ * the BufMappingLock, the caller must pin the buffer and then check that it
+ * still holds the page, see BufferAlloc.
  *
  *
  * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
@@ -21,19 +35,67 @@
  */
 #include "postgres.h"
 
+#include "port/atomics.h"
 #include "storage/bufmgr.h"
 #include "storage/buf_internals.h"
+#include "utils/hsearch.h"
 
 
 /* entry for buffer lookup hashtable */
 typedef struct
 {
 	BufferTag	key;			/* Tag of a disk page */
-	int			id;				/* Associated buffer ID */
+	int			id;				/* Associated buffer ID, or -1 if unused */
 } BufferLookupEnt;
 
-static HTAB *SharedBufHash;
+/* one sub-table, padded to a cache line to keep the counters apart */
+typedef struct
+{
+	pg_atomic_uint32 changecount;	/* odd while being modified */
+	uint32		mask;			/* number of entries - 1 */
+	Size		offset;			/* index of first entry in BufTableEntries */
+} BufTablePartitionData;
+
+typedef union
+{
+	BufTablePartitionData part;
+	char		pad[PG_CACHE_LINE_SIZE];
+} BufTablePartition;
+
+/* How many times a lookup starts over before it takes the lock */
+#define BUFTABLE_LOOKUP_RETRIES		8
+
+static BufTablePartition *BufTablePartitions;
+static BufferLookupEnt *BufTableEntries;
+
+/* The probe sequence starts at the hash bits not used to pick the partition */
+#define BufTableHashStart(hashcode, part) \
+	(((hashcode) / NUM_BUFFER_PARTITIONS) & (part)->mask)
+
+static uint32 BufTablePartitionSize(int size);
+static int	BufTableProbe(BufTablePartitionData *part, BufferTag *tagPtr,
+			  uint32 hashcode);
+
+
+/*
+ * Compute the number of entries in each sub-table
+ *		size is the desired hash table size (possibly more than NBuffers)
+ *
+ * The tags are spread over the partitions by their hash codes, so any one
+ * partition can get more than its share.  We keep the expected load under
+ * one half, and leave room for a deviation far beyond anything the hash
+ * function will produce in practice.
+ */
+static uint32
+BufTablePartitionSize(int size)
+{
+	uint32		expected = size / NUM_BUFFER_PARTITIONS + 1;
+	uint32		entries = 16;
 
+	while (entries < 2 * expected + 16)
+		entries <<= 1;
+	return entries;
+}
 
 /*
  * Estimate space needed for mapping hashtable
@@ -42,7 +104,15 @@ static HTAB *SharedBufHash;
 Size
 BufTableShmemSize(int size)
 {
-	return hash_estimate_size(size, sizeof(BufferLookupEnt));
+	Size		result;
+
+	result = mul_size(NUM_BUFFER_PARTITIONS, sizeof(BufTablePartition));
+	result = add_size(result, PG_CACHE_LINE_SIZE);
+	result = add_size(result,
+					  mul_size(mul_size(NUM_BUFFER_PARTITIONS,
+										BufTablePartitionSize(size)),
+							   sizeof(BufferLookupEnt)));
+	return result;
 }
 
 /*
@@ -52,19 +122,36 @@ BufTableShmemSize(int size)
 void
 InitBufTable(int size)
 {
-	HASHCTL		info;
+	uint32		entries = BufTablePartitionSize(size);
+	bool		found;
+	char	   *ptr;
 
 	/* assume no locking is needed yet */
 
-	/* BufferTag maps to Buffer */
-	info.keysize = sizeof(BufferTag);
-	info.entrysize = sizeof(BufferLookupEnt);
-	info.num_partitions = NUM_BUFFER_PARTITIONS;
+	ptr = ShmemInitStruct("Shared Buffer Lookup Table",
+						  BufTableShmemSize(size), &found);
+
+	/* Align the sub-tables to a cacheline boundary. */
+	BufTablePartitions = (BufTablePartition *) CACHELINEALIGN(ptr);
+	BufTableEntries = (BufferLookupEnt *)
+		(BufTablePartitions + NUM_BUFFER_PARTITIONS);
+
+	if (!found)
+	{
+		Size		i;
+
+		for (i = 0; i < NUM_BUFFER_PARTITIONS; i++)
+		{
+			BufTablePartitionData *part = &BufTablePartitions[i].part;
+
+			pg_atomic_init_u32(&part->changecount, 0);
+			part->mask = entries - 1;
+			part->offset = i * entries;
+		}
 
-	SharedBufHash = ShmemInitHash("Shared Buffer Lookup Table",
-								  size, size,
-								  &info,
-								  HASH_ELEM | HASH_BLOBS | HASH_PARTITION);
+		for (i = 0; i < NUM_BUFFER_PARTITIONS * (Size) entries; i++)
+			BufTableEntries[i].id = -1;
+	}
 }
 
 /*
@@ -79,31 +166,89 @@ InitBufTable(int size)
 uint32
 BufTableHashCode(BufferTag *tagPtr)
 {
-	return get_hash_value(SharedBufHash, (void *) tagPtr);
+	return tag_hash((void *) tagPtr, sizeof(BufferTag));
+}
+
+/*
+ * BufTableProbe
+ *		Find the entry for the given tag in a sub-table
+ *
+ * Returns the index of the entry within the sub-table, or -1 if there's
+ * none.  Without a lock on the partition, the result is only meaningful if
+ * the sub-table's change counter was even, and didn't change meanwhile.
+ */
+static int
+BufTableProbe(BufTablePartitionData *part, BufferTag *tagPtr,
+			  uint32 hashcode)
+{
+	volatile BufferLookupEnt *entries = BufTableEntries + part->offset;
+	uint32		i = BufTableHashStart(hashcode, part);
+	uint32		probes;
+
+	/* bounded, in case a concurrent writer makes us miss the empty entry */
+	for (probes = 0; probes <= part->mask; probes++)
+	{
+		volatile BufferLookupEnt *ent = &entries[i];
+
+		if (ent->id < 0)
+			return -1;
+		if (BUFFERTAGS_EQUAL(ent->key, *tagPtr))
+			return (int) i;
+		i = (i + 1) & part->mask;
+	}
+	return -1;
 }
 
 /*
  * BufTableLookup
  *		Lookup the given BufferTag; return buffer ID, or -1 if not found
  *
- * Caller must hold at least share lock on BufMappingLock for tag's partition
+ * No lock is needed.  If the caller doesn't hold the BufMappingLock for the
+ * tag's partition, though, the page may have been evicted from the buffer
+ * by the time we return, or read into one if we say it's not there.
  */
 int
 BufTableLookup(BufferTag *tagPtr, uint32 hashcode)
 {
-	BufferLookupEnt *result;
+	BufTablePartitionData *part =
+	&BufTablePartitions[BufTableHashPartition(hashcode)].part;
+	int			retries;
+	int			i;
+	int			result;
+
+	for (retries = 0; retries < BUFTABLE_LOOKUP_RETRIES; retries++)
+	{
+		uint32		before;
+		uint32		after;
+
+		before = pg_atomic_read_u32(&part->changecount);
+		if (before & 1)
+		{
+			/* a writer is busy, give it a moment */
+			pg_spin_delay();
+			continue;
+		}
+		pg_read_barrier();
+
+		i = BufTableProbe(part, tagPtr, hashcode);
+		result = (i < 0) ? -1 : BufTableEntries[part->offset + i].id;
 
-	result = (BufferLookupEnt *)
-		hash_search_with_hash_value(SharedBufHash,
-									(void *) tagPtr,
-									hashcode,
-									HASH_FIND,
-									NULL);
+		pg_read_barrier();
+		after = pg_atomic_read_u32(&part->changecount);
+		if (before == after)
+			return result;
+	}
 
-	if (!result)
-		return -1;
+	/*
+	 * We keep running into writers; get in line for the lock instead of
+	 * starving.  Holding it shared keeps writers out, so one probe will do.
+	 */
+	LWLockAcquire(BufMappingPartitionLock(hashcode), LW_SHARED);
+	i = BufTableProbe(part, tagPtr, hashcode);
+	result = (i < 0) ? -1 : BufTableEntries[part->offset + i].id;
+	LWLockRelease(BufMappingPartitionLock(hashcode));
 
-	return result->id;
+	return result;
 }
 
 /*
@@ -119,23 +264,43 @@ BufTableLookup(BufferTag *tagPtr, uint32 hashcode)
 int
 BufTableInsert(BufferTag *tagPtr, uint32 hashcode, int buf_id)
 {
-	BufferLookupEnt *result;
-	bool		found;
+	BufTablePartitionData *part =
+	&BufTablePartitions[BufTableHashPartition(hashcode)].part;
+	BufferLookupEnt *entries = BufTableEntries + part->offset;
+	uint32		i = BufTableHashStart(hashcode, part);
+	uint32		probes = 0;
 
 	Assert(buf_id >= 0);		/* -1 is reserved for not-in-table */
 	Assert(tagPtr->blockNum != P_NEW);	/* invalid tag */
 
-	result = (BufferLookupEnt *)
-		hash_search_with_hash_value(SharedBufHash,
-									(void *) tagPtr,
-									hashcode,
-									HASH_ENTER,
-									&found);
+	for (;;)
+	{
+		BufferLookupEnt *ent = &entries[i];
+
+		if (ent->id < 0)
+			break;
+		if (BUFFERTAGS_EQUAL(ent->key, *tagPtr))
+			return ent->id;		/* found something already in the table */
+		i = (i + 1) & part->mask;
+
+		/* see BufTablePartitionSize; shouldn't happen */
+		if (++probes > part->mask)
+			elog(ERROR, "shared buffer hash table is full");
+	}
 
-	if (found)					/* found something already in the table */
-		return result->id;
+	/*
+	 * Fill in the key before the id, so that a reader never takes a half
+	 * written entry as the end of a probe sequence.  Readers that overlap
+	 * with us retry anyway, because of the change counter.
+	 */
+	pg_atomic_fetch_add_u32(&part->changecount, 1);
+	pg_write_barrier();
 
-	result->id = buf_id;
+	entries[i].key = *tagPtr;
+	entries[i].id = buf_id;
+
+	pg_write_barrier();
+	pg_atomic_fetch_add_u32(&part->changecount, 1);
 
 	return -1;
 }
@@ -144,20 +309,53 @@ BufTableInsert(BufferTag *tagPtr, uint32 hashcode, int buf_id)
  * BufTableDelete
  *		Delete the hashtable entry for given tag (which must exist)
  *
+ * The entries following it in the same probe sequence are moved back to
+ * fill the hole, so that deleting never leaves tombstones behind and the
+ * sequences stay as short as the load factor allows.
+ *
  * Caller must hold exclusive lock on BufMappingLock for tag's partition
  */
 void
 BufTableDelete(BufferTag *tagPtr, uint32 hashcode)
 {
-	BufferLookupEnt *result;
-
-	result = (BufferLookupEnt *)
-		hash_search_with_hash_value(SharedBufHash,
-									(void *) tagPtr,
-									hashcode,
-									HASH_REMOVE,
-									NULL);
+	BufTablePartitionData *part =
+	&BufTablePartitions[BufTableHashPartition(hashcode)].part;
+	BufferLookupEnt *entries = BufTableEntries + part->offset;
+	int			hole;
+	uint32		i;
 
-	if (!result)				/* shouldn't happen */
+	hole = BufTableProbe(part, tagPtr, hashcode);
+	if (hole < 0)				/* shouldn't happen */
 		elog(ERROR, "shared buffer hash table corrupted");
+
+	pg_atomic_fetch_add_u32(&part->changecount, 1);
+	pg_write_barrier();
+
+	i = (uint32) hole;
+	for (;;)
+	{
+		BufferLookupEnt *ent;
+		uint32		home;
+
+		i = (i + 1) & part->mask;
+		ent = &entries[i];
+		if (ent->id < 0)
+			break;
+
+		/*
+		 * The entry can move into the hole unless its probe sequence starts
+		 * after the hole (cyclically speaking), in which case a lookup would
+		 * never get to see it there.
+		 */
+		home = BufTableHashStart(BufTableHashCode(&ent->key), part);
+		if (((i - home) & part->mask) >= ((i - (uint32) hole) & part->mask))
+		{
+			entries[hole] = *ent;
+			hole = (int) i;
+		}
+	}
+	entries[hole].id = -1;
+
+	pg_write_barrier();
+	pg_atomic_fetch_add_u32(&part->changecount, 1);
 }
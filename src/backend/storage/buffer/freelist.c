@@ -15,16 +15,31 @@
  */
 #include "postgres.h"
 
+#include "access/htup_details.h"
+#include "catalog/pg_type.h"
+#include "funcapi.h"
+#include "miscadmin.h"
 #include "port/atomics.h"
+#include "port/pg_numa.h"
 #include "storage/buf_internals.h"
 #include "storage/bufmgr.h"
 #include "storage/proc.h"
+#include "utils/builtins.h"
 
 #define INT_ACCESS_ONCE(var)	((int)(*((volatile int *)&(var))))
 
+/* How many allocations between checks of which node we're running on */
+#define BUFFER_NODE_RECHECK_INTERVAL	64
+
 
 /*
- * The shared freelist control information.
+ * One partition of the buffer pool, with its own freelist and clock sweep.
+ *
+ * Normally there's just one partition covering all of shared buffers.  With
+ * numa_buffers = partition there's one per NUMA node, each covering a
+ * contiguous range of buffers whose memory lives on that node.  Backends
+ * take victims from the partition of the node they're running on when they
+ * can, so that buffers they read into are local to them.
  */
 typedef struct
 {
@@ -32,9 +47,10 @@ typedef struct
 	slock_t		buffer_strategy_lock;
 
 	/*
-	 * Clock sweep hand: index of next buffer to consider grabbing. Note that
-	 * this isn't a concrete buffer - we only ever increase the value. So, to
-	 * get an actual buffer, it needs to be used modulo NBuffers.
+	 * Clock sweep hand: index of next buffer to consider grabbing, relative
+	 * to firstBuffer. Note that this isn't a concrete buffer - we only ever
+	 * increase the value. So, to get an actual buffer, it needs to be used
+	 * modulo numBuffers.
 	 */
 	pg_atomic_uint32 nextVictimBuffer;
 
@@ -46,11 +62,52 @@ typedef struct
 	 * when the list is empty)
 	 */
 
+	uint32		completePasses; /* Complete cycles of the clock sweep */
+
+	/* Fixed after initialization */
+	int			firstBuffer;	/* first buffer id in this partition */
+	int			numBuffers;		/* number of buffers in this partition */
+	int			node;			/* NUMA node the memory is on, or -1 */
+
+	/*
+	 * Ring of victim buffers found ahead of time by the bgwriter, see
+	 * StrategyPushVictim.  ringHead is the index of the next entry to pop,
+	 * ringTail that of the next entry to push; both only ever increase, so
+	 * the ring is empty when they're equal.  The entries are stored in
+	 * VictimRings[ringOffset .. ringOffset + ringSize - 1].
+	 */
+	pg_atomic_uint32 ringHead;
+	pg_atomic_uint32 ringTail;
+	int			ringOffset;
+	int			ringSize;
+
+	/* Statistics, see pg_stat_get_buffer_nodes */
+	pg_atomic_uint64 numAllocs; /* victims taken from this partition */
+	pg_atomic_uint64 numRemoteAllocs;	/* ... by backends on another node */
+	pg_atomic_uint64 numRingAllocs;		/* ... popped off the victim ring */
+	pg_atomic_uint64 numSweepAllocs;	/* ... found by running clock sweep */
+	pg_atomic_uint64 numDirtyAllocs;	/* ... that the backend had to write */
+} BufferStrategyPartition;
+
+/* Pad each partition to a cache line, so that their hands don't share one */
+typedef union
+{
+	BufferStrategyPartition part;
+	char		pad[TYPEALIGN(PG_CACHE_LINE_SIZE, sizeof(BufferStrategyPartition))];
+} BufferStrategyPartitionPadded;
+
+/*
+ * The shared freelist control information.
+ */
+typedef struct
+{
+	/* Spinlock: protects bgwprocno */
+	slock_t		buffer_strategy_lock;
+
 	/*
 	 * Statistics.  These counters should be wide enough that they can't
 	 * overflow during a single bgwriter cycle.
 	 */
-	uint32		completePasses; /* Complete cycles of the clock sweep */
 	pg_atomic_uint32 numBufferAllocs;	/* Buffers allocated since last reset */
 
 	/*
@@ -58,10 +115,29 @@ typedef struct
 	 * StrategyNotifyBgWriter.
 	 */
 	int			bgwprocno;
+
+	/*
+	 * The partitions.  All but the last have partitionSize buffers, the last
+	 * one takes the remainder.
+	 */
+	int			numPartitions;
+	int			partitionSize;
+	BufferStrategyPartitionPadded partitions[PG_NUMA_MAX_NODES];
 } BufferStrategyControl;
 
 /* Pointers to shared state */
 static BufferStrategyControl *StrategyControl = NULL;
+static int *VictimRings = NULL;
+
+#define GetStrategyPartition(i) (&StrategyControl->partitions[(i)].part)
+
+/*
+ * The partition for the NUMA node this backend last found itself running
+ * on, and the node itself (-1 if unknown).
+ */
+static int	MyBufferPartition = 0;
+static int	MyBufferNode = -1;
+static int	allocsSinceNodeCheck = BUFFER_NODE_RECHECK_INTERVAL;
 
 /*
  * Private (non-shared) state for managing a ring of shared buffers to re-use.
@@ -98,18 +174,28 @@ typedef struct BufferAccessStrategyData
 
 
 /* Prototypes for internal functions */
-static volatile BufferDesc *GetBufferFromRing(BufferAccessStrategy strategy);
+static void UpdateBufferPartition(void);
+static volatile BufferDesc *GetBufferFromFreelist(BufferStrategyPartition *part,
+					  BufferAccessStrategy strategy, uint32 *buf_state);
+static volatile BufferDesc *GetBufferFromClockSweep(BufferStrategyPartition *part,
+						BufferAccessStrategy strategy, uint32 *buf_state);
+static volatile BufferDesc *GetBufferFromVictimRing(BufferStrategyPartition *part,
+						BufferAccessStrategy strategy, uint32 *buf_state);
+static void CountBufferAlloc(BufferStrategyPartition *part);
+static int	VictimRingsSize(void);
+static volatile BufferDesc *GetBufferFromRing(BufferAccessStrategy strategy,
+				  uint32 *buf_state);
 static void AddBufferToRing(BufferAccessStrategy strategy,
 				volatile BufferDesc *buf);
 
 /*
  * ClockSweepTick - Helper routine for StrategyGetBuffer()
  *
- * Move the clock hand one buffer ahead of its current position and return the
- * id of the buffer now under the hand.
+ * Move the partition's clock hand one buffer ahead of its current position
+ * and return the id of the buffer now under the hand.
  */
 static inline uint32
-ClockSweepTick(void)
+ClockSweepTick(BufferStrategyPartition *part)
 {
 	uint32		victim;
 
@@ -119,14 +205,14 @@ ClockSweepTick(void)
 	 * apparent order.
 	 */
 	victim =
-		pg_atomic_fetch_add_u32(&StrategyControl->nextVictimBuffer, 1);
+		pg_atomic_fetch_add_u32(&part->nextVictimBuffer, 1);
 
-	if (victim >= NBuffers)
+	if (victim >= part->numBuffers)
 	{
 		uint32		originalVictim = victim;
 
 		/* always wrap what we look up in BufferDescriptors */
-		victim = victim % NBuffers;
+		victim = victim % part->numBuffers;
 
 		/*
 		 * If we're the one that just caused a wraparound, force
@@ -152,19 +238,70 @@ ClockSweepTick(void)
 				 * could lead to an overflow of nextVictimBuffers, but that's
 				 * highly unlikely and wouldn't be particularly harmful.
 				 */
-				SpinLockAcquire(&StrategyControl->buffer_strategy_lock);
+				SpinLockAcquire(&part->buffer_strategy_lock);
 
-				wrapped = expected % NBuffers;
+				wrapped = expected % part->numBuffers;
 
-				success = pg_atomic_compare_exchange_u32(&StrategyControl->nextVictimBuffer,
+				success = pg_atomic_compare_exchange_u32(&part->nextVictimBuffer,
 														 &expected, wrapped);
 				if (success)
-					StrategyControl->completePasses++;
-				SpinLockRelease(&StrategyControl->buffer_strategy_lock);
+					part->completePasses++;
+				SpinLockRelease(&part->buffer_strategy_lock);
 			}
 		}
 	}
-	return victim;
+	return part->firstBuffer + victim;
+}
+
+/*
+ * UpdateBufferPartition -- find out which partition is local to us
+ *
+ * Backends can be moved between CPUs, and so between nodes, at any time, so
+ * we check again every so often.  Asking the kernel is cheap, but not so
+ * cheap that we want to do it for every buffer.
+ */
+static void
+UpdateBufferPartition(void)
+{
+	int			node;
+	int			i;
+
+	if (++allocsSinceNodeCheck < BUFFER_NODE_RECHECK_INTERVAL)
+		return;
+	allocsSinceNodeCheck = 0;
+
+	if (StrategyControl->numPartitions == 1)
+	{
+		MyBufferPartition = 0;
+		if (GetStrategyPartition(0)->node >= 0)
+			MyBufferNode = pg_numa_current_node();
+		return;
+	}
+
+	node = pg_numa_current_node();
+	MyBufferNode = node;
+	for (i = 0; i < StrategyControl->numPartitions; i++)
+	{
+		if (GetStrategyPartition(i)->node == node)
+		{
+			MyBufferPartition = i;
+			return;
+		}
+	}
+
+	/* not on any node we know of; spread the load by process */
+	MyBufferPartition = MyProcPid % StrategyControl->numPartitions;
+}
+
+/*
+ * CountBufferAlloc -- update the statistics for a victim taken from part
+ */
+static void
+CountBufferAlloc(BufferStrategyPartition *part)
+{
+	pg_atomic_fetch_add_u64(&part->numAllocs, 1);
+	if (part->node >= 0 && MyBufferNode != part->node)
+		pg_atomic_fetch_add_u64(&part->numRemoteAllocs, 1);
 }
 
 /*
@@ -177,14 +314,25 @@ ClockSweepTick(void)
  *	strategy is a BufferAccessStrategy object, or NULL for default strategy.
  *
  *	To ensure that no one else can pin the buffer before we do, we must
- *	return the buffer with the buffer header spinlock still held.
+ *	return the buffer with the buffer header spinlock still held.  The
+ *	buffer's state as of acquiring that lock is returned in *buf_state.
+ *
+ *	Free buffers are used first.  After that we take the buffers the bgwriter
+ *	has lined up for us in the victim ring, and only when that's empty do we
+ *	run the clock sweep ourselves.
+ *
+ *	When the pool is partitioned by NUMA node, we look for a victim in the
+ *	partition local to us first.  A free buffer on another node is still
+ *	preferable to evicting a page locally, though, and only if every buffer
+ *	of our own partition is pinned do we sweep the other partitions.
  */
 volatile BufferDesc *
-StrategyGetBuffer(BufferAccessStrategy strategy)
+StrategyGetBuffer(BufferAccessStrategy strategy, uint32 *buf_state)
 {
 	volatile BufferDesc *buf;
 	int			bgwprocno;
-	int			trycounter;
+	int			numPartitions = StrategyControl->numPartitions;
+	int			i;
 
 	/*
 	 * If given a strategy object, see whether it can select a buffer. We
@@ -192,7 +340,7 @@ StrategyGetBuffer(BufferAccessStrategy strategy)
 	 */
 	if (strategy != NULL)
 	{
-		buf = GetBufferFromRing(strategy);
+		buf = GetBufferFromRing(strategy, buf_state);
 		if (buf != NULL)
 			return buf;
 	}
@@ -230,6 +378,71 @@ StrategyGetBuffer(BufferAccessStrategy strategy)
 	 */
 	pg_atomic_fetch_add_u32(&StrategyControl->numBufferAllocs, 1);
 
+	UpdateBufferPartition();
+
+	/* Try the freelists, starting with our own partition's */
+	for (i = 0; i < numPartitions; i++)
+	{
+		BufferStrategyPartition *part =
+		GetStrategyPartition((MyBufferPartition + i) % numPartitions);
+
+		buf = GetBufferFromFreelist(part, strategy, buf_state);
+		if (buf != NULL)
+		{
+			CountBufferAlloc(part);
+			return buf;
+		}
+	}
+
+	/*
+	 * Nothing on the freelists, so take a victim from the bgwriter's ring,
+	 * or failing that run the "clock sweep" algorithm.
+	 */
+	for (i = 0; i < numPartitions; i++)
+	{
+		BufferStrategyPartition *part =
+		GetStrategyPartition((MyBufferPartition + i) % numPartitions);
+
+		buf = GetBufferFromVictimRing(part, strategy, buf_state);
+		if (buf != NULL)
+		{
+			pg_atomic_fetch_add_u64(&part->numRingAllocs, 1);
+			CountBufferAlloc(part);
+			return buf;
+		}
+
+		buf = GetBufferFromClockSweep(part, strategy, buf_state);
+		if (buf != NULL)
+		{
+			pg_atomic_fetch_add_u64(&part->numSweepAllocs, 1);
+			CountBufferAlloc(part);
+			return buf;
+		}
+	}
+
+	/*
+	 * We've scanned all the buffers without making any state changes, so all
+	 * the buffers are pinned (or were when we looked at them). We could hope
+	 * that someone will free one eventually, but it's probably better to fail
+	 * than to risk getting stuck in an infinite loop.
+	 */
+	elog(ERROR, "no unpinned buffers available");
+	return NULL;				/* keep compiler quiet */
+}
+
+/*
+ * GetBufferFromFreelist -- pop a usable buffer off a partition's freelist
+ *
+ * Returns NULL if the freelist is empty.  Otherwise the buffer is returned
+ * with its header spinlock held, as for StrategyGetBuffer.
+ */
+static volatile BufferDesc *
+GetBufferFromFreelist(BufferStrategyPartition *part,
+					  BufferAccessStrategy strategy, uint32 *buf_state)
+{
+	volatile BufferDesc *buf;
+	uint32		local_buf_state;	/* to avoid repeated (de-)referencing */
+
 	/*
 	 * First check, without acquiring the lock, whether there's buffers in the
 	 * freelist. Since we otherwise don't require the spinlock in every
@@ -246,101 +459,282 @@ StrategyGetBuffer(BufferAccessStrategy strategy)
 	 * buffer_strategy_lock not the individual buffer spinlocks, so it's OK to
 	 * manipulate them without holding the spinlock.
 	 */
-	if (StrategyControl->firstFreeBuffer >= 0)
+	if (INT_ACCESS_ONCE(part->firstFreeBuffer) < 0)
+		return NULL;
+
+	while (true)
 	{
-		while (true)
+		/* Acquire the spinlock to remove element from the freelist */
+		SpinLockAcquire(&part->buffer_strategy_lock);
+
+		if (part->firstFreeBuffer < 0)
 		{
-			/* Acquire the spinlock to remove element from the freelist */
-			SpinLockAcquire(&StrategyControl->buffer_strategy_lock);
+			SpinLockRelease(&part->buffer_strategy_lock);
+			return NULL;
+		}
 
-			if (StrategyControl->firstFreeBuffer < 0)
-			{
-				SpinLockRelease(&StrategyControl->buffer_strategy_lock);
-				break;
-			}
+		buf = GetBufferDescriptor(part->firstFreeBuffer);
+		Assert(buf->freeNext != FREENEXT_NOT_IN_LIST);
 
-			buf = GetBufferDescriptor(StrategyControl->firstFreeBuffer);
-			Assert(buf->freeNext != FREENEXT_NOT_IN_LIST);
+		/* Unconditionally remove buffer from freelist */
+		part->firstFreeBuffer = buf->freeNext;
+		buf->freeNext = FREENEXT_NOT_IN_LIST;
 
-			/* Unconditionally remove buffer from freelist */
-			StrategyControl->firstFreeBuffer = buf->freeNext;
-			buf->freeNext = FREENEXT_NOT_IN_LIST;
+		/*
+		 * Release the lock so someone else can access the freelist while we
+		 * check out this buffer.
+		 */
+		SpinLockRelease(&part->buffer_strategy_lock);
 
-			/*
-			 * Release the lock so someone else can access the freelist while
-			 * we check out this buffer.
-			 */
-			SpinLockRelease(&StrategyControl->buffer_strategy_lock);
+		/*
+		 * If the buffer is pinned or has a nonzero usage_count, we cannot use
+		 * it; discard it and retry.  (This can only happen if VACUUM put a
+		 * valid buffer in the freelist and then someone else used it before
+		 * we got to it.  It's probably impossible altogether as of 8.3, but
+		 * we'd better check anyway.)
+		 */
+		local_buf_state = LockBufHdr(buf);
+		if (BUF_STATE_GET_REFCOUNT(local_buf_state) == 0
+			&& BUF_STATE_GET_USAGECOUNT(local_buf_state) == 0)
+		{
+			if (strategy != NULL)
+				AddBufferToRing(strategy, buf);
+			*buf_state = local_buf_state;
+			return buf;
+		}
+		UnlockBufHdr(buf, local_buf_state);
+	}
+}
 
-			/*
-			 * If the buffer is pinned or has a nonzero usage_count, we cannot
-			 * use it; discard it and retry.  (This can only happen if VACUUM
-			 * put a valid buffer in the freelist and then someone else used
-			 * it before we got to it.  It's probably impossible altogether as
-			 * of 8.3, but we'd better check anyway.)
-			 */
-			LockBufHdr(buf);
-			if (buf->refcount == 0 && buf->usage_count == 0)
-			{
-				if (strategy != NULL)
-					AddBufferToRing(strategy, buf);
-				return buf;
-			}
-			UnlockBufHdr(buf);
+/*
+ * GetBufferFromVictimRing -- pop a usable buffer off a partition's victim ring
+ *
+ * Returns NULL if the ring is empty.  Otherwise the buffer is returned with
+ * its header spinlock held, as for StrategyGetBuffer.
+ *
+ * The ring has only one producer, the bgwriter, but any number of consumers,
+ * which claim an entry by advancing ringHead with compare-and-exchange.  If
+ * the entry we read gets overwritten by the bgwriter before we've claimed
+ * it, ringHead must have moved on, so the exchange fails and we retry; the
+ * counters are 32 bits wide so that they don't wrap around meanwhile.
+ */
+static volatile BufferDesc *
+GetBufferFromVictimRing(BufferStrategyPartition *part,
+						BufferAccessStrategy strategy, uint32 *buf_state)
+{
+	volatile BufferDesc *buf;
+	uint32		local_buf_state;	/* to avoid repeated (de-)referencing */
+
+	for (;;)
+	{
+		uint32		head;
+		uint32		tail;
+		int			buf_id;
+
+		head = pg_atomic_read_u32(&part->ringHead);
+		tail = pg_atomic_read_u32(&part->ringTail);
+		if (head == tail)
+			return NULL;
+
+		/* make sure we read the entry after the tail that covers it */
+		pg_read_barrier();
+		buf_id = VictimRings[part->ringOffset + head % part->ringSize];
 
+		if (!pg_atomic_compare_exchange_u32(&part->ringHead, &head, head + 1))
+			continue;
+
+		/*
+		 * The buffer was reusable when the bgwriter pushed it, but it could
+		 * have been used again since.  If so, just skip it; the clock sweep
+		 * will get to it again in due course.
+		 */
+		buf = GetBufferDescriptor(buf_id);
+		local_buf_state = LockBufHdr(buf);
+		if (BUF_STATE_GET_REFCOUNT(local_buf_state) == 0
+			&& BUF_STATE_GET_USAGECOUNT(local_buf_state) == 0)
+		{
+			if (strategy != NULL)
+				AddBufferToRing(strategy, buf);
+			*buf_state = local_buf_state;
+			return buf;
 		}
+		UnlockBufHdr(buf, local_buf_state);
 	}
+}
 
-	/* Nothing on the freelist, so run the "clock sweep" algorithm */
-	trycounter = NBuffers;
+/*
+ * GetBufferFromClockSweep -- run the clock sweep over one partition
+ *
+ * Returns NULL if every buffer in the partition is pinned.  Otherwise the
+ * buffer is returned with its header spinlock held, as for StrategyGetBuffer.
+ */
+static volatile BufferDesc *
+GetBufferFromClockSweep(BufferStrategyPartition *part,
+						BufferAccessStrategy strategy, uint32 *buf_state)
+{
+	volatile BufferDesc *buf;
+	int			trycounter;
+	uint32		local_buf_state;	/* to avoid repeated (de-)referencing */
+
+	trycounter = part->numBuffers;
 	for (;;)
 	{
 
-		buf = GetBufferDescriptor(ClockSweepTick());
+		buf = GetBufferDescriptor(ClockSweepTick(part));
 
 		/*
 		 * If the buffer is pinned or has a nonzero usage_count, we cannot use
 		 * it; decrement the usage_count (unless pinned) and keep scanning.
 		 */
-		LockBufHdr(buf);
-		if (buf->refcount == 0)
+		local_buf_state = LockBufHdr(buf);
+
+		if (BUF_STATE_GET_REFCOUNT(local_buf_state) == 0)
 		{
-			if (buf->usage_count > 0)
+			if (BUF_STATE_GET_USAGECOUNT(local_buf_state) != 0)
 			{
-				buf->usage_count--;
-				trycounter = NBuffers;
+				local_buf_state -= BUF_USAGECOUNT_ONE;
+
+				trycounter = part->numBuffers;
 			}
 			else
 			{
 				/* Found a usable buffer */
 				if (strategy != NULL)
 					AddBufferToRing(strategy, buf);
+				*buf_state = local_buf_state;
 				return buf;
 			}
 		}
 		else if (--trycounter == 0)
 		{
-			/*
-			 * We've scanned all the buffers without making any state changes,
-			 * so all the buffers are pinned (or were when we looked at them).
-			 * We could hope that someone will free one eventually, but it's
-			 * probably better to fail than to risk getting stuck in an
-			 * infinite loop.
-			 */
-			UnlockBufHdr(buf);
-			elog(ERROR, "no unpinned buffers available");
+			/* Every buffer in this partition is pinned */
+			UnlockBufHdr(buf, local_buf_state);
+			return NULL;
 		}
-		UnlockBufHdr(buf);
+		UnlockBufHdr(buf, local_buf_state);
 	}
 }
 
+/*
+ * have_free_buffer -- a lockless check to see if there is a free buffer in
+ *					   the freelist of any partition
+ *
+ * Used by pg_prewarm's autoprewarm to stop before it starts evicting the
+ * blocks it has already loaded.
+ */
+bool
+have_free_buffer(void)
+{
+	int			i;
+
+	for (i = 0; i < StrategyControl->numPartitions; i++)
+	{
+		if (INT_ACCESS_ONCE(StrategyControl->partitions[i].part.firstFreeBuffer) >= 0)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * StrategyNumPartitions -- number of partitions of the buffer pool
+ *
+ * The partitions are numbered from 0; the bgwriter fills the victim ring of
+ * each of them.
+ */
+int
+StrategyNumPartitions(void)
+{
+	return StrategyControl->numPartitions;
+}
+
+/*
+ * StrategySweepPartition -- find a victim buffer for the bgwriter
+ *
+ * Advances the partition's clock sweep just as StrategyGetBuffer would, and
+ * returns the first buffer found to be reusable, with its header spinlock
+ * held.  Returns NULL if every buffer of the partition is pinned.
+ */
+volatile BufferDesc *
+StrategySweepPartition(int partition, uint32 *buf_state)
+{
+	return GetBufferFromClockSweep(GetStrategyPartition(partition), NULL,
+								   buf_state);
+}
+
+/*
+ * StrategyVictimRingSpace -- number of free entries in a victim ring
+ *
+ * The total number of entries is returned in *ring_size.
+ */
+int
+StrategyVictimRingSpace(int partition, int *ring_size)
+{
+	BufferStrategyPartition *part = GetStrategyPartition(partition);
+	uint32		head = pg_atomic_read_u32(&part->ringHead);
+	uint32		tail = pg_atomic_read_u32(&part->ringTail);
+
+	*ring_size = part->ringSize;
+	return part->ringSize - (int) (tail - head);
+}
+
+/*
+ * StrategyPushVictim -- add a reusable buffer to a partition's victim ring
+ *
+ * Only the bgwriter may call this, as the ring supports just one producer.
+ * The buffer should be clean, unpinned and have a zero usage count, but
+ * since the caller can't hold on to it, backends check that again when they
+ * pop it.  Returns false if the ring is full.
+ */
+bool
+StrategyPushVictim(int partition, int buf_id)
+{
+	BufferStrategyPartition *part = GetStrategyPartition(partition);
+	uint32		head = pg_atomic_read_u32(&part->ringHead);
+	uint32		tail = pg_atomic_read_u32(&part->ringTail);
+
+	Assert(buf_id >= part->firstBuffer &&
+		   buf_id < part->firstBuffer + part->numBuffers);
+
+	if ((int) (tail - head) >= part->ringSize)
+		return false;
+
+	VictimRings[part->ringOffset + tail % part->ringSize] = buf_id;
+
+	/* make sure the entry is visible before the tail that covers it */
+	pg_write_barrier();
+	pg_atomic_write_u32(&part->ringTail, tail + 1);
+
+	return true;
+}
+
+/*
+ * StrategyReportDirtyVictim -- count a victim the backend had to write out
+ *
+ * Called by BufferAlloc when the buffer StrategyGetBuffer returned was
+ * dirty, which is just what the bgwriter's victim ring is meant to avoid.
+ */
+void
+StrategyReportDirtyVictim(volatile BufferDesc *buf)
+{
+	BufferStrategyPartition *part;
+
+	part = GetStrategyPartition(Min(buf->buf_id / StrategyControl->partitionSize,
+									StrategyControl->numPartitions - 1));
+	pg_atomic_fetch_add_u64(&part->numDirtyAllocs, 1);
+}
+
 /*
  * StrategyFreeBuffer: put a buffer on the freelist
  */
 void
 StrategyFreeBuffer(volatile BufferDesc *buf)
 {
-	SpinLockAcquire(&StrategyControl->buffer_strategy_lock);
+	BufferStrategyPartition *part;
+
+	part = GetStrategyPartition(Min(buf->buf_id / StrategyControl->partitionSize,
+									StrategyControl->numPartitions - 1));
+
+	SpinLockAcquire(&part->buffer_strategy_lock);
 
 	/*
 	 * It is possible that we are told to put something in the freelist that
@@ -348,13 +742,13 @@ StrategyFreeBuffer(volatile BufferDesc *buf)
 	 */
 	if (buf->freeNext == FREENEXT_NOT_IN_LIST)
 	{
-		buf->freeNext = StrategyControl->firstFreeBuffer;
+		buf->freeNext = part->firstFreeBuffer;
 		if (buf->freeNext < 0)
-			StrategyControl->lastFreeBuffer = buf->buf_id;
-		StrategyControl->firstFreeBuffer = buf->buf_id;
+			part->lastFreeBuffer = buf->buf_id;
+		part->firstFreeBuffer = buf->buf_id;
 	}
 
-	SpinLockRelease(&StrategyControl->buffer_strategy_lock);
+	SpinLockRelease(&part->buffer_strategy_lock);
 }
 
 /*
@@ -367,34 +761,46 @@ StrategyFreeBuffer(volatile BufferDesc *buf)
  * the higher-order bits of nextVictimBuffer) and the count of recent buffer
  * allocs if non-NULL pointers are passed.  The alloc count is reset after
  * being read.
+ *
+ * With several partitions there is no single clock hand.  We then report
+ * the total distance travelled by all the hands, as if they were one hand
+ * going around all of shared buffers.
+ *
+ * The bgwriter only uses the alloc count nowadays, since it runs the clock
+ * sweep itself to fill the victim rings; see BgBufferSync.
  */
 int
 StrategySyncStart(uint32 *complete_passes, uint32 *num_buf_alloc)
 {
-	uint32		nextVictimBuffer;
-	int			result;
+	uint64		total = 0;
+	int			i;
 
-	SpinLockAcquire(&StrategyControl->buffer_strategy_lock);
-	nextVictimBuffer = pg_atomic_read_u32(&StrategyControl->nextVictimBuffer);
-	result = nextVictimBuffer % NBuffers;
-
-	if (complete_passes)
+	for (i = 0; i < StrategyControl->numPartitions; i++)
 	{
-		*complete_passes = StrategyControl->completePasses;
+		BufferStrategyPartition *part = GetStrategyPartition(i);
+		uint32		nextVictimBuffer;
+
+		SpinLockAcquire(&part->buffer_strategy_lock);
+		nextVictimBuffer = pg_atomic_read_u32(&part->nextVictimBuffer);
 
 		/*
-		 * Additionally add the number of wraparounds that happened before
-		 * completePasses could be incremented. C.f. ClockSweepTick().
+		 * nextVictimBuffer can exceed numBuffers by the wraparounds that
+		 * happened before completePasses could be incremented. C.f.
+		 * ClockSweepTick().
 		 */
-		*complete_passes += nextVictimBuffer / NBuffers;
+		total += (uint64) part->completePasses * part->numBuffers +
+			nextVictimBuffer;
+		SpinLockRelease(&part->buffer_strategy_lock);
 	}
 
+	if (complete_passes)
+		*complete_passes = (uint32) (total / NBuffers);
+
 	if (num_buf_alloc)
 	{
 		*num_buf_alloc = pg_atomic_exchange_u32(&StrategyControl->numBufferAllocs, 0);
 	}
-	SpinLockRelease(&StrategyControl->buffer_strategy_lock);
-	return result;
+	return (int) (total % NBuffers);
 }
 
 /*
@@ -419,6 +825,18 @@ StrategyNotifyBgWriter(int bgwprocno)
 }
 
 
+/*
+ * VictimRingsSize -- total number of entries in the victim rings
+ *
+ * The rings should be able to hold the buffers allocated between two bgwriter
+ * rounds, but there's no point in lining up a large fraction of the pool.
+ */
+static int
+VictimRingsSize(void)
+{
+	return Max(NBuffers / 16, 1);
+}
+
 /*
  * StrategyShmemSize
  *
@@ -438,6 +856,9 @@ StrategyShmemSize(void)
 	/* size of the shared replacement strategy control block */
 	size = add_size(size, MAXALIGN(sizeof(BufferStrategyControl)));
 
+	/* size of the victim rings */
+	size = add_size(size, mul_size(VictimRingsSize(), sizeof(int)));
+
 	return size;
 }
 
@@ -445,13 +866,19 @@ StrategyShmemSize(void)
  * StrategyInitialize -- initialize the buffer cache replacement
  *		strategy.
  *
+ * numPartitions, partitionSize and nodes describe how InitBufferPool laid
+ * out the buffers over NUMA nodes; see there.  They're only looked at when
+ * init is true.
+ *
  * Assumes: All of the buffers are already built into a linked list.
  *		Only called by postmaster and only during initialization.
  */
 void
-StrategyInitialize(bool init)
+StrategyInitialize(bool init, int numPartitions, int partitionSize,
+				   const int *nodes)
 {
 	bool		found;
+	bool		foundRings;
 
 	/*
 	 * Initialize the shared buffer lookup hashtable.
@@ -472,28 +899,76 @@ StrategyInitialize(bool init)
 		ShmemInitStruct("Buffer Strategy Status",
 						sizeof(BufferStrategyControl),
 						&found);
+	VictimRings = (int *)
+		ShmemInitStruct("Buffer Victim Rings",
+						VictimRingsSize() * sizeof(int),
+						&foundRings);
 
 	if (!found)
 	{
+		int			ringSize;
+		int			i;
+
 		/*
 		 * Only done once, usually in postmaster
 		 */
 		Assert(init);
+		Assert(numPartitions >= 1 && numPartitions <= PG_NUMA_MAX_NODES);
 
 		SpinLockInit(&StrategyControl->buffer_strategy_lock);
 
+		StrategyControl->numPartitions = numPartitions;
+		StrategyControl->partitionSize = partitionSize;
+
 		/*
-		 * Grab the whole linked list of free buffers for our strategy. We
-		 * assume it was previously set up by InitBufferPool().
+		 * Share the victim rings out evenly.  InitBufferPool never makes
+		 * partitions small enough for this to come out as zero.
 		 */
-		StrategyControl->firstFreeBuffer = 0;
-		StrategyControl->lastFreeBuffer = NBuffers - 1;
+		ringSize = VictimRingsSize() / numPartitions;
+		Assert(ringSize > 0);
+
+		for (i = 0; i < numPartitions; i++)
+		{
+			BufferStrategyPartition *part = GetStrategyPartition(i);
+
+			SpinLockInit(&part->buffer_strategy_lock);
 
-		/* Initialize the clock sweep pointer */
-		pg_atomic_init_u32(&StrategyControl->nextVictimBuffer, 0);
+			part->firstBuffer = i * partitionSize;
+			if (i == numPartitions - 1)
+				part->numBuffers = NBuffers - part->firstBuffer;
+			else
+				part->numBuffers = partitionSize;
+			part->node = nodes[i];
+
+			/*
+			 * Grab the partition's part of the linked list of free buffers.
+			 * We assume it was previously set up by InitBufferPool(), as one
+			 * list, so cut it at the end of the partition.
+			 */
+			part->firstFreeBuffer = part->firstBuffer;
+			part->lastFreeBuffer = part->firstBuffer + part->numBuffers - 1;
+			GetBufferDescriptor(part->lastFreeBuffer)->freeNext =
+				FREENEXT_END_OF_LIST;
+
+			/* Initialize the clock sweep pointer */
+			pg_atomic_init_u32(&part->nextVictimBuffer, 0);
+
+			/* The victim ring starts out empty */
+			pg_atomic_init_u32(&part->ringHead, 0);
+			pg_atomic_init_u32(&part->ringTail, 0);
+			part->ringOffset = i * ringSize;
+			part->ringSize = ringSize;
+
+			/* Clear statistics */
+			part->completePasses = 0;
+			pg_atomic_init_u64(&part->numAllocs, 0);
+			pg_atomic_init_u64(&part->numRemoteAllocs, 0);
+			pg_atomic_init_u64(&part->numRingAllocs, 0);
+			pg_atomic_init_u64(&part->numSweepAllocs, 0);
+			pg_atomic_init_u64(&part->numDirtyAllocs, 0);
+		}
 
 		/* Clear statistics */
-		StrategyControl->completePasses = 0;
 		pg_atomic_init_u32(&StrategyControl->numBufferAllocs, 0);
 
 		/* No pending notification */
@@ -503,6 +978,111 @@ StrategyInitialize(bool init)
 		Assert(!init);
 }
 
+/*
+ * SQL-callable function returning the statistics of each partition of the
+ * buffer pool, one row per partition.
+ */
+Datum
+pg_stat_get_buffer_nodes(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	int			i;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	/* need to build tuplestore in query context */
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	/*
+	 * build tupdesc for result tuples. This must match the definition of the
+	 * pg_stat_buffer_nodes view in system_views.sql
+	 */
+	tupdesc = CreateTemplateTupleDesc(10, false);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 1, "partition",
+					   INT4OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 2, "node",
+					   INT4OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 3, "first_buffer",
+					   INT4OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 4, "buffers",
+					   INT4OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 5, "complete_passes",
+					   INT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 6, "allocs",
+					   INT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 7, "remote_allocs",
+					   INT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 8, "ring_allocs",
+					   INT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 9, "sweep_allocs",
+					   INT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 10, "dirty_allocs",
+					   INT8OID, -1, 0);
+
+	tupstore =
+		tuplestore_begin_heap(rsinfo->allowedModes & SFRM_Materialize_Random,
+							  false, work_mem);
+
+	/* generate junk in short-term context */
+	MemoryContextSwitchTo(oldcontext);
+
+	for (i = 0; i < StrategyControl->numPartitions; i++)
+	{
+		BufferStrategyPartition *part = GetStrategyPartition(i);
+		Datum		values[10];
+		bool		nulls[10];
+		uint32		completePasses;
+		uint32		nextVictimBuffer;
+
+		MemSet(nulls, 0, sizeof(nulls));
+
+		SpinLockAcquire(&part->buffer_strategy_lock);
+		completePasses = part->completePasses;
+		nextVictimBuffer = pg_atomic_read_u32(&part->nextVictimBuffer);
+		SpinLockRelease(&part->buffer_strategy_lock);
+
+		values[0] = Int32GetDatum(i);
+		if (part->node >= 0)
+			values[1] = Int32GetDatum(part->node);
+		else
+			nulls[1] = true;
+		values[2] = Int32GetDatum(part->firstBuffer);
+		values[3] = Int32GetDatum(part->numBuffers);
+		values[4] = Int64GetDatum((int64) completePasses +
+								  nextVictimBuffer / part->numBuffers);
+		values[5] = Int64GetDatum((int64) pg_atomic_read_u64(&part->numAllocs));
+		values[6] = Int64GetDatum((int64) pg_atomic_read_u64(&part->numRemoteAllocs));
+		values[7] = Int64GetDatum((int64) pg_atomic_read_u64(&part->numRingAllocs));
+		values[8] = Int64GetDatum((int64) pg_atomic_read_u64(&part->numSweepAllocs));
+		values[9] = Int64GetDatum((int64) pg_atomic_read_u64(&part->numDirtyAllocs));
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	return (Datum) 0;
+}
+
 
 /* ----------------------------------------------------------------
  *				Backend-private buffer ring management
@@ -585,10 +1165,11 @@ FreeAccessStrategy(BufferAccessStrategy strategy)
  * The bufhdr spin lock is held on the returned buffer.
  */
 static volatile BufferDesc *
-GetBufferFromRing(BufferAccessStrategy strategy)
+GetBufferFromRing(BufferAccessStrategy strategy, uint32 *buf_state)
 {
 	volatile BufferDesc *buf;
 	Buffer		bufnum;
+	uint32		local_buf_state;	/* to avoid repeated (de-)referencing */
 
 	/* Advance to next ring slot */
 	if (++strategy->current >= strategy->ring_size)
@@ -616,13 +1197,15 @@ GetBufferFromRing(BufferAccessStrategy strategy)
 	 * shouldn't re-use it.
 	 */
 	buf = GetBufferDescriptor(bufnum - 1);
-	LockBufHdr(buf);
-	if (buf->refcount == 0 && buf->usage_count <= 1)
+	local_buf_state = LockBufHdr(buf);
+	if (BUF_STATE_GET_REFCOUNT(local_buf_state) == 0
+		&& BUF_STATE_GET_USAGECOUNT(local_buf_state) <= 1)
 	{
 		strategy->current_was_in_ring = true;
+		*buf_state = local_buf_state;
 		return buf;
 	}
-	UnlockBufHdr(buf);
+	UnlockBufHdr(buf, local_buf_state);
 
 	/*
 	 * Tell caller to allocate a new buffer with the normal allocation
@@ -31,15 +31,46 @@
  * BufFile also supports temporary files that exceed the OS file size limit
  * (by opening multiple fd.c temporary files).  This is an essential feature
  * for sorts and hashjoins on large amounts of data.
+ *
+ * Temporary BufFiles can be created with two optional features, see
+ * BufFileCreateTempExtended:
+ *
+ * With BUFFILE_WRITE_BEHIND, buffers written out at consecutive positions
+ * are collected in a larger write-behind buffer, and written with a single
+ * call when it's full or before anything is read back, after which the
+ * kernel is asked to start writing them to disk, so that a large spill
+ * doesn't build up a mass of dirty pages that all have to be written out at
+ * once.  The write-behind data of a file that's closed without being read
+ * is never written at all.  This is meant for the single files of sorts and
+ * tuplestores, which are mostly written sequentially.
+ *
+ * With BUFFILE_COMPRESS, each buffer is compressed with the method selected
+ * by temp_file_compression when it's written out, and stored as a chunk
+ * with a small header.  Since the position of data in the file then no
+ * longer corresponds to its logical position, such a file must be written
+ * sequentially, and can only be read back after rewinding it to the start;
+ * that's how hash joins and hashed aggregation use their batch files.
  *-------------------------------------------------------------------------
  */
 
 #include "postgres.h"
 
+#ifdef USE_LZ4
+#include <lz4.h>
+#endif
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "common/pg_lzcompress.h"
 #include "executor/instrument.h"
+#include "pgstat.h"
 #include "storage/fd.h"
 #include "storage/buffile.h"
 #include "storage/buf_internals.h"
+#include "storage/bufmgr.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"
 #include "utils/resowner.h"
 
 /*
@@ -50,6 +81,66 @@
 #define MAX_PHYSICAL_FILESIZE	0x40000000
 #define BUFFILE_SEG_SIZE		(MAX_PHYSICAL_FILESIZE / BLCKSZ)
 
+/*
+ * Space needed to compress a buffer with any of the compression methods,
+ * as in xloginsert.c.
+ */
+#define PGLZ_MAX_BLCKSZ PGLZ_MAX_OUTPUT(BLCKSZ)
+
+#ifdef USE_LZ4
+#define LZ4_MAX_BLCKSZ	LZ4_COMPRESSBOUND(BLCKSZ)
+#else
+#define LZ4_MAX_BLCKSZ	0
+#endif
+
+#ifdef USE_ZSTD
+#define ZSTD_MAX_BLCKSZ	ZSTD_COMPRESSBOUND(BLCKSZ)
+#else
+#define ZSTD_MAX_BLCKSZ	0
+#endif
+
+#define COMPRESS_BUFSIZE	Max(Max(PGLZ_MAX_BLCKSZ, LZ4_MAX_BLCKSZ), ZSTD_MAX_BLCKSZ)
+
+/*
+ * Header of each chunk of a compressed BufFile.  If len equals rawlen, the
+ * data is stored uncompressed, because compression didn't make it smaller.
+ */
+typedef struct BufFileChunkHeader
+{
+	uint32		len;			/* # of bytes stored after the header */
+	uint32		rawlen;			/* # of bytes of data they represent */
+} BufFileChunkHeader;
+
+/*
+ * Compression methods for temporary files.  Methods the server was built
+ * without are not accepted.
+ */
+const struct config_enum_entry temp_file_compression_options[] = {
+	{"none", TEMP_FILE_COMPRESSION_NONE, false},
+	{"pglz", TEMP_FILE_COMPRESSION_PGLZ, false},
+#ifdef USE_LZ4
+	{"lz4", TEMP_FILE_COMPRESSION_LZ4, false},
+#endif
+#ifdef USE_ZSTD
+	{"zstd", TEMP_FILE_COMPRESSION_ZSTD, false},
+#endif
+	{"off", TEMP_FILE_COMPRESSION_NONE, true},
+	{"false", TEMP_FILE_COMPRESSION_NONE, true},
+	{"no", TEMP_FILE_COMPRESSION_NONE, true},
+	{"0", TEMP_FILE_COMPRESSION_NONE, true},
+	{NULL, 0, false}
+};
+
+/* GUC variables */
+int			temp_file_compression = TEMP_FILE_COMPRESSION_NONE;
+int			temp_file_write_behind = 128;
+
+/*
+ * Work space for compressing and decompressing a chunk, shared by all
+ * compressed BufFiles of the backend, with room for the header in front.
+ */
+static char *compress_buffer = NULL;
+
 /*
  * This data structure represents a buffered file that consists of one or
  * more physical files (each accessed through a virtual file descriptor
@@ -71,6 +162,9 @@ struct BufFile
 	bool		isInterXact;	/* keep open over transactions? */
 	bool		dirty;			/* does buffer need to be written? */
 
+	/* compression method if BUFFILE_COMPRESS, else NONE */
+	TempFileCompression compression;
+
 	/*
 	 * resowner is the ResourceOwner to use for underlying temp files.  (We
 	 * don't need to remember the memory context we're using explicitly,
@@ -86,13 +180,33 @@ struct BufFile
 	off_t		curOffset;		/* offset part of current pos */
 	int			pos;			/* next read/write position in buffer */
 	int			nbytes;			/* total # of valid bytes in buffer */
+
+	/*
+	 * Write-behind buffer, if BUFFILE_WRITE_BEHIND was given.  The wbnbytes
+	 * bytes pending in it belong at wbOffset in component file wbFile.
+	 */
+	char	   *wbuffer;
+	int			wbsize;			/* allocated size of wbuffer */
+	int			wbnbytes;		/* # of bytes pending in wbuffer */
+	int			wbFile;			/* file index of pending data */
+	off_t		wbOffset;		/* offset of pending data */
+
 	char		buffer[BLCKSZ];
 };
 
 static BufFile *makeBufFile(File firstfile);
 static void extendBufFile(BufFile *file);
+static int	BufFileReadFile(BufFile *file, int fileno, off_t offset,
+				char *data, int nbytes);
+static int	BufFileWriteFile(BufFile *file, int fileno, off_t offset,
+				 char *data, int nbytes);
+static bool BufFileFlushWriteBehind(BufFile *file);
+static int	BufFileReadPhysical(BufFile *file, char *data, int nbytes);
+static int	BufFileWritePhysical(BufFile *file, char *data, int nbytes);
 static void BufFileLoadBuffer(BufFile *file);
+static void BufFileLoadCompressedBuffer(BufFile *file);
 static void BufFileDumpBuffer(BufFile *file);
+static void BufFileDumpCompressedBuffer(BufFile *file);
 static int	BufFileFlush(BufFile *file);
 
 
@@ -113,11 +227,17 @@ makeBufFile(File firstfile)
 	file->isTemp = false;
 	file->isInterXact = false;
 	file->dirty = false;
+	file->compression = TEMP_FILE_COMPRESSION_NONE;
 	file->resowner = CurrentResourceOwner;
 	file->curFile = 0;
 	file->curOffset = 0L;
 	file->pos = 0;
 	file->nbytes = 0;
+	file->wbuffer = NULL;
+	file->wbsize = 0;
+	file->wbnbytes = 0;
+	file->wbFile = 0;
+	file->wbOffset = 0L;
 
 	return file;
 }
@@ -164,6 +284,25 @@ extendBufFile(BufFile *file)
  */
 BufFile *
 BufFileCreateTemp(bool interXact)
+{
+	return BufFileCreateTempExtended(interXact, 0);
+}
+
+/*
+ * Like BufFileCreateTemp, with the optional features selected by flags:
+ *
+ * BUFFILE_WRITE_BEHIND collects data written at consecutive positions in a
+ * buffer of temp_file_write_behind kilobytes before writing it out.  This
+ * costs that much memory for as long as the file is open, so it's meant for
+ * callers that only have one or two files open at a time.
+ *
+ * BUFFILE_COMPRESS compresses the data with the temp_file_compression
+ * method, if any.  The caller must write the file sequentially, and may
+ * only read it after rewinding it with BufFileSeek(file, 0, 0L, SEEK_SET),
+ * after which it may not write to it anymore.
+ */
+BufFile *
+BufFileCreateTempExtended(bool interXact, int flags)
 {
 	BufFile    *file;
 	File		pfile;
@@ -175,6 +314,23 @@ BufFileCreateTemp(bool interXact)
 	file->isTemp = true;
 	file->isInterXact = interXact;
 
+	if ((flags & BUFFILE_WRITE_BEHIND) &&
+		temp_file_write_behind >= 2 * BLCKSZ / 1024)
+	{
+		file->wbsize = temp_file_write_behind * 1024;
+		file->wbuffer = palloc(file->wbsize);
+	}
+
+	if ((flags & BUFFILE_COMPRESS) &&
+		temp_file_compression != TEMP_FILE_COMPRESSION_NONE)
+	{
+		file->compression = (TempFileCompression) temp_file_compression;
+		if (compress_buffer == NULL)
+			compress_buffer = MemoryContextAlloc(TopMemoryContext,
+												 sizeof(BufFileChunkHeader) +
+												 COMPRESS_BUFSIZE);
+	}
+
 	return file;
 }
 
@@ -203,86 +359,213 @@ BufFileClose(BufFile *file)
 {
 	int			i;
 
-	/* flush any unwritten data */
-	BufFileFlush(file);
+	/*
+	 * Flush any unwritten data, unless it's a temp file, which we're about
+	 * to delete anyway.  That also saves writing its write-behind data.
+	 */
+	if (!file->isTemp)
+	{
+		BufFileFlush(file);
+		BufFileFlushWriteBehind(file);
+	}
 	/* close the underlying file(s) (with delete if it's a temp file) */
 	for (i = 0; i < file->numFiles; i++)
 		FileClose(file->files[i]);
 	/* release the buffer space */
 	pfree(file->files);
 	pfree(file->offsets);
+	if (file->wbuffer)
+		pfree(file->wbuffer);
 	pfree(file);
 }
 
 /*
- * BufFileLoadBuffer
+ * BufFileReadFile
  *
- * Load some data into buffer, if possible, starting from curOffset.
- * At call, must have dirty = false, pos and nbytes = 0.
- * On exit, nbytes is number of bytes loaded.
+ * Read up to nbytes at the given offset of component file fileno, timing
+ * the read if track_io_timing is on.  Returns what FileRead returns, or -1
+ * if the seek failed.
  */
-static void
-BufFileLoadBuffer(BufFile *file)
+static int
+BufFileReadFile(BufFile *file, int fileno, off_t offset, char *data,
+				int nbytes)
 {
-	File		thisfile;
+	File		thisfile = file->files[fileno];
+	instr_time	io_start,
+				io_time;
+	int			nread;
 
 	/*
-	 * Advance to next component file if necessary and possible.
-	 *
-	 * This path can only be taken if there is more than one component, so it
-	 * won't interfere with reading a non-temp file that is over
-	 * MAX_PHYSICAL_FILESIZE.
+	 * May need to reposition physical file.
 	 */
-	if (file->curOffset >= MAX_PHYSICAL_FILESIZE &&
-		file->curFile + 1 < file->numFiles)
+	if (offset != file->offsets[fileno])
 	{
-		file->curFile++;
-		file->curOffset = 0L;
+		if (FileSeek(thisfile, offset, SEEK_SET) != offset)
+			return -1;
+		file->offsets[fileno] = offset;
 	}
 
-	/*
-	 * May need to reposition physical file.
-	 */
-	thisfile = file->files[file->curFile];
-	if (file->curOffset != file->offsets[file->curFile])
+	if (track_io_timing)
+		INSTR_TIME_SET_CURRENT(io_start);
+
+	pgstat_report_wait_start(WAIT_EVENT_BUFFILE_READ);
+	nread = FileRead(thisfile, data, nbytes);
+	pgstat_report_wait_end();
+
+	if (track_io_timing)
 	{
-		if (FileSeek(thisfile, file->curOffset, SEEK_SET) != file->curOffset)
-			return;				/* seek failed, read nothing */
-		file->offsets[file->curFile] = file->curOffset;
+		INSTR_TIME_SET_CURRENT(io_time);
+		INSTR_TIME_SUBTRACT(io_time, io_start);
+		INSTR_TIME_ADD(pgBufferUsage.temp_blk_read_time, io_time);
 	}
 
-	/*
-	 * Read whatever we can get, up to a full bufferload.
-	 */
-	file->nbytes = FileRead(thisfile, file->buffer, sizeof(file->buffer));
-	if (file->nbytes < 0)
-		file->nbytes = 0;
-	file->offsets[file->curFile] += file->nbytes;
-	/* we choose not to advance curOffset here */
+	if (nread > 0)
+		file->offsets[fileno] += nread;
 
-	pgBufferUsage.temp_blks_read++;
+	return nread;
 }
 
 /*
- * BufFileDumpBuffer
+ * BufFileWriteFile
  *
- * Dump buffer contents starting at curOffset.
- * At call, should have dirty = true, nbytes > 0.
- * On exit, dirty is cleared if successful write, and curOffset is advanced.
+ * The counterpart of BufFileReadFile.
  */
-static void
-BufFileDumpBuffer(BufFile *file)
+static int
+BufFileWriteFile(BufFile *file, int fileno, off_t offset, char *data,
+				 int nbytes)
+{
+	File		thisfile = file->files[fileno];
+	instr_time	io_start,
+				io_time;
+	int			nwritten;
+
+	if (offset != file->offsets[fileno])
+	{
+		if (FileSeek(thisfile, offset, SEEK_SET) != offset)
+			return -1;
+		file->offsets[fileno] = offset;
+	}
+
+	if (track_io_timing)
+		INSTR_TIME_SET_CURRENT(io_start);
+
+	pgstat_report_wait_start(WAIT_EVENT_BUFFILE_WRITE);
+	nwritten = FileWrite(thisfile, data, nbytes);
+	pgstat_report_wait_end();
+
+	if (track_io_timing)
+	{
+		INSTR_TIME_SET_CURRENT(io_time);
+		INSTR_TIME_SUBTRACT(io_time, io_start);
+		INSTR_TIME_ADD(pgBufferUsage.temp_blk_write_time, io_time);
+	}
+
+	if (nwritten > 0)
+		file->offsets[fileno] += nwritten;
+
+	return nwritten;
+}
+
+/*
+ * BufFileFlushWriteBehind
+ *
+ * Write out the data pending in the write-behind buffer, if any, and ask
+ * the kernel to start writing it to disk in the background.  Returns false
+ * if the write failed.
+ */
+static bool
+BufFileFlushWriteBehind(BufFile *file)
 {
 	int			wpos = 0;
-	int			bytestowrite;
-	File		thisfile;
 
-	/*
-	 * Unlike BufFileLoadBuffer, we must dump the whole buffer even if it
-	 * crosses a component-file boundary; so we need a loop.
-	 */
-	while (wpos < file->nbytes)
+	while (wpos < file->wbnbytes)
 	{
+		int			nwritten;
+
+		nwritten = BufFileWriteFile(file, file->wbFile, file->wbOffset + wpos,
+									file->wbuffer + wpos,
+									file->wbnbytes - wpos);
+		if (nwritten <= 0)
+			return false;
+		wpos += nwritten;
+	}
+
+	if (file->wbnbytes > 0)
+		FileWriteback(file->files[file->wbFile], file->wbOffset,
+					  file->wbnbytes);
+	file->wbnbytes = 0;
+
+	return true;
+}
+
+/*
+ * BufFileReadPhysical
+ *
+ * Read up to nbytes from (curFile, curOffset), moving on to the next
+ * component file at the end of one, and advance curOffset past them.
+ * Returns the number of bytes read, less than nbytes only at the end of the
+ * file or on failure.
+ */
+static int
+BufFileReadPhysical(BufFile *file, char *data, int nbytes)
+{
+	int			rpos = 0;
+
+	while (rpos < nbytes)
+	{
+		int			bytestoread = nbytes - rpos;
+		int			nread;
+
+		/*
+		 * Advance to next component file if necessary and possible.
+		 */
+		if (file->curOffset >= MAX_PHYSICAL_FILESIZE &&
+			file->curFile + 1 < file->numFiles)
+		{
+			file->curFile++;
+			file->curOffset = 0L;
+		}
+
+		if (file->isTemp)
+		{
+			off_t		availbytes = MAX_PHYSICAL_FILESIZE - file->curOffset;
+
+			if ((off_t) bytestoread > availbytes)
+				bytestoread = (int) availbytes;
+			if (bytestoread <= 0)
+				break;
+		}
+
+		nread = BufFileReadFile(file, file->curFile, file->curOffset,
+								data + rpos, bytestoread);
+		if (nread <= 0)
+			break;
+		file->curOffset += nread;
+		rpos += nread;
+	}
+
+	return rpos;
+}
+
+/*
+ * BufFileWritePhysical
+ *
+ * Write nbytes at (curFile, curOffset), moving on to the next component
+ * file when one is full, and advance curOffset past them.  With a
+ * write-behind buffer, the data is only collected there, if it continues
+ * the data already pending.  Returns the number of bytes written, which is
+ * less than nbytes only on failure.
+ */
+static int
+BufFileWritePhysical(BufFile *file, char *data, int nbytes)
+{
+	int			wpos = 0;
+
+	while (wpos < nbytes)
+	{
+		int			bytestowrite;
+		int			nwritten;
+
 		/*
 		 * Advance to next component file if necessary and possible.
 		 */
@@ -298,7 +581,7 @@ BufFileDumpBuffer(BufFile *file)
 		 * Enforce per-file size limit only for temp files, else just try to
 		 * write as much as asked...
 		 */
-		bytestowrite = file->nbytes - wpos;
+		bytestowrite = nbytes - wpos;
 		if (file->isTemp)
 		{
 			off_t		availbytes = MAX_PHYSICAL_FILESIZE - file->curOffset;
@@ -307,27 +590,207 @@ BufFileDumpBuffer(BufFile *file)
 				bytestowrite = (int) availbytes;
 		}
 
-		/*
-		 * May need to reposition physical file.
-		 */
-		thisfile = file->files[file->curFile];
-		if (file->curOffset != file->offsets[file->curFile])
+		if (file->wbuffer != NULL)
+		{
+			/* Write out what's pending if this doesn't continue it */
+			if (file->wbnbytes > 0 &&
+				(file->wbFile != file->curFile ||
+				 file->wbOffset + file->wbnbytes != file->curOffset ||
+				 file->wbnbytes + bytestowrite > file->wbsize))
+			{
+				if (!BufFileFlushWriteBehind(file))
+					break;
+			}
+
+			if (bytestowrite <= file->wbsize - file->wbnbytes)
+			{
+				if (file->wbnbytes == 0)
+				{
+					file->wbFile = file->curFile;
+					file->wbOffset = file->curOffset;
+				}
+				memcpy(file->wbuffer + file->wbnbytes, data + wpos,
+					   bytestowrite);
+				file->wbnbytes += bytestowrite;
+				file->curOffset += bytestowrite;
+				wpos += bytestowrite;
+				continue;
+			}
+		}
+
+		nwritten = BufFileWriteFile(file, file->curFile, file->curOffset,
+									data + wpos, bytestowrite);
+		if (nwritten <= 0)
+			break;				/* failed to write */
+		file->curOffset += nwritten;
+		wpos += nwritten;
+	}
+
+	return wpos;
+}
+
+/*
+ * BufFileLoadBuffer
+ *
+ * Load some data into buffer, if possible, starting from curOffset.
+ * At call, must have dirty = false, pos and nbytes = 0.
+ * On exit, nbytes is number of bytes loaded.
+ */
+static void
+BufFileLoadBuffer(BufFile *file)
+{
+	off_t		curOffset = file->curOffset;
+	int			curFile = file->curFile;
+
+	/* The data might still be waiting to be written */
+	if (!BufFileFlushWriteBehind(file))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write to temporary file: %m")));
+
+	if (file->compression != TEMP_FILE_COMPRESSION_NONE)
+	{
+		BufFileLoadCompressedBuffer(file);
+		return;
+	}
+
+	/*
+	 * Advance to next component file if necessary and possible.
+	 *
+	 * This path can only be taken if there is more than one component, so
+	 * it won't interfere with reading a non-temp file that is over
+	 * MAX_PHYSICAL_FILESIZE.
+	 */
+	if (curOffset >= MAX_PHYSICAL_FILESIZE &&
+		curFile + 1 < file->numFiles)
+	{
+		file->curFile = ++curFile;
+		file->curOffset = curOffset = 0L;
+	}
+
+	/*
+	 * Read whatever we can get, up to a full bufferload.
+	 */
+	file->nbytes = BufFileReadFile(file, curFile, curOffset, file->buffer,
+								   sizeof(file->buffer));
+	if (file->nbytes < 0)
+		file->nbytes = 0;
+	/* we choose not to advance curOffset here */
+
+	pgBufferUsage.temp_blks_read++;
+}
+
+/*
+ * BufFileLoadCompressedBuffer
+ *
+ * BufFileLoadBuffer for a compressed file: read the next chunk, and
+ * decompress it into the buffer.  Unlike for other files, curOffset is
+ * advanced past the chunk.
+ */
+static void
+BufFileLoadCompressedBuffer(BufFile *file)
+{
+	BufFileChunkHeader hdr;
+	char	   *data = compress_buffer + sizeof(BufFileChunkHeader);
+	int			nread;
+	bool		ok;
+
+	nread = BufFileReadPhysical(file, (char *) &hdr, sizeof(hdr));
+	if (nread == 0)
+		return;					/* end of file */
+	if (nread != sizeof(hdr))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read from temporary file: %m")));
+	if (hdr.rawlen > BLCKSZ || hdr.len > COMPRESS_BUFSIZE ||
+		hdr.len > hdr.rawlen)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_CORRUPTED),
+				 errmsg("invalid compressed data in temporary file")));
+
+	if (hdr.len == hdr.rawlen)
+		data = file->buffer;	/* stored uncompressed */
+
+	if (BufFileReadPhysical(file, data, hdr.len) != hdr.len)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read from temporary file: %m")));
+
+	if (data == file->buffer)
+		ok = true;
+	else
+	{
+		switch (file->compression)
 		{
-			if (FileSeek(thisfile, file->curOffset, SEEK_SET) != file->curOffset)
-				return;			/* seek failed, give up */
-			file->offsets[file->curFile] = file->curOffset;
+			case TEMP_FILE_COMPRESSION_PGLZ:
+				ok = pglz_decompress(data, hdr.len, file->buffer,
+									 hdr.rawlen, true) == hdr.rawlen;
+				break;
+
+#ifdef USE_LZ4
+			case TEMP_FILE_COMPRESSION_LZ4:
+				ok = LZ4_decompress_safe(data, file->buffer, hdr.len,
+										 hdr.rawlen) == hdr.rawlen;
+				break;
+#endif
+
+#ifdef USE_ZSTD
+			case TEMP_FILE_COMPRESSION_ZSTD:
+				{
+					size_t		result = ZSTD_decompress(file->buffer,
+														 hdr.rawlen,
+														 data, hdr.len);
+
+					ok = !ZSTD_isError(result) && result == hdr.rawlen;
+				}
+				break;
+#endif
+
+			default:
+				elog(ERROR, "unrecognized temporary file compression method: %d",
+					 file->compression);
+				ok = false;		/* keep compiler quiet */
+				break;
 		}
-		bytestowrite = FileWrite(thisfile, file->buffer + wpos, bytestowrite);
-		if (bytestowrite <= 0)
-			return;				/* failed to write */
-		file->offsets[file->curFile] += bytestowrite;
-		file->curOffset += bytestowrite;
-		wpos += bytestowrite;
-
-		pgBufferUsage.temp_blks_written++;
 	}
+
+	if (!ok)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_CORRUPTED),
+				 errmsg("could not decompress temporary file data")));
+
+	file->nbytes = hdr.rawlen;
+
+	pgBufferUsage.temp_blks_read++;
+}
+
+/*
+ * BufFileDumpBuffer
+ *
+ * Dump buffer contents starting at curOffset.
+ * At call, should have dirty = true, nbytes > 0.
+ * On exit, dirty is cleared if successful write, and curOffset is advanced.
+ */
+static void
+BufFileDumpBuffer(BufFile *file)
+{
+	if (file->compression != TEMP_FILE_COMPRESSION_NONE)
+	{
+		BufFileDumpCompressedBuffer(file);
+		return;
+	}
+
+	/*
+	 * Unlike BufFileLoadBuffer, we must dump the whole buffer even if it
+	 * crosses a component-file boundary, which BufFileWritePhysical takes
+	 * care of.
+	 */
+	if (BufFileWritePhysical(file, file->buffer, file->nbytes) != file->nbytes)
+		return;					/* failed to write */
 	file->dirty = false;
 
+	pgBufferUsage.temp_blks_written++;
+
 	/*
 	 * At this point, curOffset has been advanced to the end of the buffer,
 	 * ie, its original value + nbytes.  We need to make it point to the
@@ -349,6 +812,78 @@ BufFileDumpBuffer(BufFile *file)
 	file->nbytes = 0;
 }
 
+/*
+ * BufFileDumpCompressedBuffer
+ *
+ * BufFileDumpBuffer for a compressed file: compress the buffer and append
+ * it as a chunk.  Since compressed files are written sequentially, pos
+ * equals nbytes here.
+ */
+static void
+BufFileDumpCompressedBuffer(BufFile *file)
+{
+	BufFileChunkHeader *hdr = (BufFileChunkHeader *) compress_buffer;
+	char	   *dest = compress_buffer + sizeof(BufFileChunkHeader);
+	int			len;
+
+	Assert(file->pos == file->nbytes);
+
+	switch (file->compression)
+	{
+		case TEMP_FILE_COMPRESSION_PGLZ:
+			len = pglz_compress(file->buffer, file->nbytes, dest,
+								PGLZ_strategy_always);
+			break;
+
+#ifdef USE_LZ4
+		case TEMP_FILE_COMPRESSION_LZ4:
+			len = LZ4_compress_default(file->buffer, dest, file->nbytes,
+									   COMPRESS_BUFSIZE);
+			if (len <= 0)
+				len = -1;		/* failure */
+			break;
+#endif
+
+#ifdef USE_ZSTD
+		case TEMP_FILE_COMPRESSION_ZSTD:
+			{
+				/* temp data is short-lived, so go for speed */
+				size_t		result = ZSTD_compress(dest, COMPRESS_BUFSIZE,
+												   file->buffer, file->nbytes,
+												   1);
+
+				len = ZSTD_isError(result) ? -1 : (int) result;
+			}
+			break;
+#endif
+
+		default:
+			elog(ERROR, "unrecognized temporary file compression method: %d",
+				 file->compression);
+			len = -1;			/* keep compiler quiet */
+			break;
+	}
+
+	/* Store the data as is if it didn't compress */
+	if (len < 0 || len >= file->nbytes)
+	{
+		memcpy(dest, file->buffer, file->nbytes);
+		len = file->nbytes;
+	}
+	hdr->len = len;
+	hdr->rawlen = file->nbytes;
+
+	len += sizeof(BufFileChunkHeader);
+	if (BufFileWritePhysical(file, compress_buffer, len) != len)
+		return;					/* failed to write */
+	file->dirty = false;
+
+	pgBufferUsage.temp_blks_written++;
+
+	file->pos = 0;
+	file->nbytes = 0;
+}
+
 /*
  * BufFileRead
  *
@@ -372,7 +907,8 @@ BufFileRead(BufFile *file, void *ptr, size_t size)
 		if (file->pos >= file->nbytes)
 		{
 			/* Try to load more data into buffer. */
-			file->curOffset += file->pos;
+			if (file->compression == TEMP_FILE_COMPRESSION_NONE)
+				file->curOffset += file->pos;
 			file->pos = 0;
 			file->nbytes = 0;
 			BufFileLoadBuffer(file);
@@ -421,6 +957,7 @@ BufFileWrite(BufFile *file, void *ptr, size_t size)
 			else
 			{
 				/* Hmm, went directly from reading to writing? */
+				Assert(file->compression == TEMP_FILE_COMPRESSION_NONE);
 				file->curOffset += file->pos;
 				file->pos = 0;
 				file->nbytes = 0;
@@ -480,6 +1017,20 @@ BufFileSeek(BufFile *file, int fileno, off_t offset, int whence)
 	int			newFile;
 	off_t		newOffset;
 
+	/* A compressed file can only be rewound, see BufFileCreateTempExtended */
+	if (file->compression != TEMP_FILE_COMPRESSION_NONE)
+	{
+		if (whence != SEEK_SET || fileno != 0 || offset != 0)
+			elog(ERROR, "cannot seek in a compressed temporary file");
+		if (BufFileFlush(file) != 0)
+			return EOF;
+		file->curFile = 0;
+		file->curOffset = 0L;
+		file->pos = 0;
+		file->nbytes = 0;
+		return 0;
+	}
+
 	switch (whence)
 	{
 		case SEEK_SET:
@@ -563,6 +1114,7 @@ BufFileSeek(BufFile *file, int fileno, off_t offset, int whence)
 void
 BufFileTell(BufFile *file, int *fileno, off_t *offset)
 {
+	Assert(file->compression == TEMP_FILE_COMPRESSION_NONE);
 	*fileno = file->curFile;
 	*offset = file->curOffset + file->pos;
 }
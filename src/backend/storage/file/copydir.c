@@ -21,12 +21,19 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#ifdef HAVE_LINUX_FS_H
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
 
 #include "storage/copydir.h"
 #include "storage/fd.h"
 #include "miscadmin.h"
 
 
+/* Amount to copy per copy_file_range() call, between interrupt checks */
+#define COPY_RANGE_SIZE (1024 * 1024)
+
 /*
  * copydir: copy a directory
  *
@@ -128,6 +135,80 @@ copydir(char *fromdir, char *todir, bool recurse)
 	fsync_fname(todir, true);
 }
 
+/*
+ * Try to copy the rest of the file without passing the data through our
+ * buffer, by having the filesystem clone the file or copy it in the kernel.
+ * Returns the number of bytes copied, with the file offsets of both files
+ * advanced past them; if the filesystem can't do either, the caller copies
+ * the remainder, if any, itself.
+ */
+static off_t
+copy_file_in_kernel(int srcfd, char *fromfile, int dstfd, char *tofile)
+{
+	off_t		offset = 0;
+
+#ifdef FICLONE
+
+	/*
+	 * On filesystems with copy-on-write extents (btrfs, XFS with reflink,
+	 * ...) the file can share its data with the original until either is
+	 * modified, which is nearly free and takes no extra space.
+	 */
+	if (ioctl(dstfd, FICLONE, srcfd) == 0)
+	{
+		struct stat fst;
+
+		if (fstat(srcfd, &fst) < 0)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not stat file \"%s\": %m", fromfile)));
+		if (lseek(srcfd, fst.st_size, SEEK_SET) < 0 ||
+			lseek(dstfd, fst.st_size, SEEK_SET) < 0)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not seek in file \"%s\": %m", tofile)));
+		return fst.st_size;
+	}
+#endif
+
+#ifdef HAVE_COPY_FILE_RANGE
+
+	/*
+	 * Otherwise, copy_file_range() at least saves copying the data to user
+	 * space and back, and lets network filesystems copy on the server side.
+	 * It fails with EXDEV, EINVAL or the like where the kernel or filesystem
+	 * doesn't support it, before copying anything.
+	 */
+	for (;;)
+	{
+		ssize_t		nbytes;
+
+		/* If we got a cancel signal during the copy of the file, quit */
+		CHECK_FOR_INTERRUPTS();
+
+		nbytes = copy_file_range(srcfd, NULL, dstfd, NULL, COPY_RANGE_SIZE, 0);
+		if (nbytes < 0)
+		{
+			if (offset == 0 &&
+				(errno == EXDEV || errno == EINVAL || errno == ENOSYS ||
+				 errno == EOPNOTSUPP || errno == EPERM))
+				break;
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not copy file \"%s\" to \"%s\": %m",
+							fromfile, tofile)));
+		}
+		if (nbytes == 0)
+			break;
+
+		(void) pg_flush_data(dstfd, offset, nbytes);
+		offset += nbytes;
+	}
+#endif
+
+	return offset;
+}
+
 /*
  * copy one file
  */
@@ -162,9 +243,12 @@ copy_file(char *fromfile, char *tofile)
 				 errmsg("could not create file \"%s\": %m", tofile)));
 
 	/*
-	 * Do the data copying.
+	 * Do the data copying, in the kernel if possible, then any remainder
+	 * through our buffer.
 	 */
-	for (offset = 0;; offset += nbytes)
+	offset = copy_file_in_kernel(srcfd, fromfile, dstfd, tofile);
+
+	for (;; offset += nbytes)
 	{
 		/* If we got a cancel signal during the copy of the file, quit */
 		CHECK_FOR_INTERRUPTS();
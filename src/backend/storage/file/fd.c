@@ -1289,6 +1289,66 @@ FilePrefetch(File file, off_t offset, int amount)
 #endif
 }
 
+/*
+ * FileWriteback --- ask the kernel to start writing back a range of a file
+ *
+ * This is only a hint, used to spread out the I/O of a checkpoint so that
+ * the fsync at its end has less to do; errors are ignored.
+ */
+void
+FileWriteback(File file, off_t offset, off_t nbytes)
+{
+	int			returnCode;
+
+	Assert(FileIsValid(file));
+
+	DO_DB(elog(LOG, "FileWriteback: %d (%s) " INT64_FORMAT " " INT64_FORMAT,
+			   file, VfdCache[file].fileName,
+			   (int64) offset, (int64) nbytes));
+
+	if (nbytes <= 0)
+		return;
+
+	returnCode = FileAccess(file);
+	if (returnCode < 0)
+		return;
+
+	(void) pg_flush_data(VfdCache[file].fd, offset, nbytes);
+}
+
+/*
+ * FilePreallocate --- reserve disk space for a range of a file
+ *
+ * The space is allocated without changing the file's size, so that later
+ * writes extending the file into the range needn't allocate it piecemeal.
+ * Like FileWriteback this is only an optimization, and errors are ignored;
+ * it does nothing where fallocate() isn't available.
+ */
+void
+FilePreallocate(File file, off_t offset, off_t nbytes)
+{
+#ifdef FALLOC_FL_KEEP_SIZE
+	int			returnCode;
+
+	Assert(FileIsValid(file));
+
+	DO_DB(elog(LOG, "FilePreallocate: %d (%s) " INT64_FORMAT " " INT64_FORMAT,
+			   file, VfdCache[file].fileName,
+			   (int64) offset, (int64) nbytes));
+
+	if (nbytes <= 0)
+		return;
+
+	returnCode = FileAccess(file);
+	if (returnCode < 0)
+		return;
+
+	(void) fallocate(VfdCache[file].fd, FALLOC_FL_KEEP_SIZE, offset, nbytes);
+#else
+	Assert(FileIsValid(file));
+#endif
+}
+
 int
 FileRead(File file, char *buffer, int amount)
 {
@@ -1439,6 +1499,141 @@ retry:
 	return returnCode;
 }
 
+/*
+ * FileReadV - read from the current position into several buffers
+ *
+ * This is FileRead for a run of buffers that aren't adjacent in memory, such
+ * as a group of shared buffers covering consecutive blocks of a relation:
+ * the data is transferred with a single readv() call.  The result is the
+ * total number of bytes read, which can be less than the total size of the
+ * buffers at end of file, or -1 with errno set.
+ *
+ * Windows has no readv(), so there we read each buffer in turn, stopping at
+ * a short read.
+ */
+int
+FileReadV(File file, const struct iovec * iov, int iovcnt)
+{
+	int			returnCode;
+
+	Assert(FileIsValid(file));
+
+	DO_DB(elog(LOG, "FileReadV: %d (%s) " INT64_FORMAT " %d",
+			   file, VfdCache[file].fileName,
+			   (int64) VfdCache[file].seekPos,
+			   iovcnt));
+
+#ifndef WIN32
+	returnCode = FileAccess(file);
+	if (returnCode < 0)
+		return returnCode;
+
+retry:
+	returnCode = readv(VfdCache[file].fd, iov, iovcnt);
+
+	if (returnCode >= 0)
+		VfdCache[file].seekPos += returnCode;
+	else
+	{
+		/* OK to retry if interrupted */
+		if (errno == EINTR)
+			goto retry;
+
+		/* Trouble, so assume we don't know the file position anymore */
+		VfdCache[file].seekPos = FileUnknownPos;
+	}
+#else
+	{
+		int			i;
+		int			nbytes;
+
+		returnCode = 0;
+		for (i = 0; i < iovcnt; i++)
+		{
+			nbytes = FileRead(file, iov[i].iov_base, iov[i].iov_len);
+			if (nbytes < 0)
+				return nbytes;
+			returnCode += nbytes;
+			if (nbytes != iov[i].iov_len)
+				break;
+		}
+	}
+#endif
+
+	return returnCode;
+}
+
+/*
+ * FileWriteV - write several buffers at the current position
+ *
+ * The counterpart of FileReadV.  Temporary files aren't supported, since we
+ * don't bother with temp_file_limit accounting here.
+ */
+int
+FileWriteV(File file, const struct iovec * iov, int iovcnt)
+{
+	int			returnCode;
+
+	Assert(FileIsValid(file));
+	Assert(!(VfdCache[file].fdstate & FD_TEMPORARY));
+
+	DO_DB(elog(LOG, "FileWriteV: %d (%s) " INT64_FORMAT " %d",
+			   file, VfdCache[file].fileName,
+			   (int64) VfdCache[file].seekPos,
+			   iovcnt));
+
+#ifndef WIN32
+	returnCode = FileAccess(file);
+	if (returnCode < 0)
+		return returnCode;
+
+retry:
+	errno = 0;
+	returnCode = writev(VfdCache[file].fd, iov, iovcnt);
+
+	if (returnCode >= 0)
+	{
+		Size		amount = 0;
+		int			i;
+
+		/* if write didn't set errno, assume problem is no disk space */
+		for (i = 0; i < iovcnt; i++)
+			amount += iov[i].iov_len;
+		if ((Size) returnCode != amount && errno == 0)
+			errno = ENOSPC;
+
+		VfdCache[file].seekPos += returnCode;
+	}
+	else
+	{
+		/* OK to retry if interrupted */
+		if (errno == EINTR)
+			goto retry;
+
+		/* Trouble, so assume we don't know the file position anymore */
+		VfdCache[file].seekPos = FileUnknownPos;
+	}
+#else
+	{
+		int			i;
+		int			nbytes;
+
+		returnCode = 0;
+		for (i = 0; i < iovcnt; i++)
+		{
+			nbytes = FileWrite(file, iov[i].iov_base, iov[i].iov_len);
+			if (nbytes < 0)
+				return nbytes;
+			returnCode += nbytes;
+			if (nbytes != iov[i].iov_len)
+				break;
+		}
+	}
+#endif
+
+	return returnCode;
+}
+
 int
 FileSync(File file)
 {
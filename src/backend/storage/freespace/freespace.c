@@ -108,6 +108,7 @@ static Size fsm_space_cat_to_avail(uint8 cat);
 static int fsm_set_and_search(Relation rel, FSMAddress addr, uint16 slot,
 				   uint8 newValue, uint8 minValue);
 static BlockNumber fsm_search(Relation rel, uint8 min_cat);
+static void fsm_update_parents(Relation rel, FSMAddress addr, uint8 value);
 static uint8 fsm_vacuum_page(Relation rel, FSMAddress addr, bool *eof);
 
 
@@ -188,6 +189,62 @@ RecordPageWithFreeSpace(Relation rel, BlockNumber heapBlk, Size spaceAvail)
 	fsm_set_and_search(rel, addr, slot, new_cat, 0);
 }
 
+/*
+ * RecordPageRangeWithFreeSpace - update info about a range of pages.
+ *
+ * All pages from startBlk to endBlk, inclusive, are recorded as having
+ * spaceAvail free.  Unlike RecordPageWithFreeSpace, the upper level pages
+ * are updated too, so searchers see the space right away.  This is meant
+ * for newly added pages, which are recorded in bulk when a relation is
+ * extended by more than one page at a time.
+ */
+void
+RecordPageRangeWithFreeSpace(Relation rel, BlockNumber startBlk,
+							 BlockNumber endBlk, Size spaceAvail)
+{
+	int			new_cat = fsm_space_avail_to_cat(spaceAvail);
+	BlockNumber blk = startBlk;
+
+	Assert(startBlk <= endBlk);
+
+	for (;;)
+	{
+		FSMAddress	addr;
+		uint16		slot;
+		Buffer		buf;
+		Page		page;
+		bool		dirty = false;
+		uint8		max_avail;
+
+		/* Set all the slots for the range that are on this FSM page */
+		addr = fsm_get_location(blk, &slot);
+		buf = fsm_readbuf(rel, addr, true);
+		LockBuffer(buf, BUFFER_LOCK_EXCLUSIVE);
+		page = BufferGetPage(buf);
+
+		for (;;)
+		{
+			if (fsm_set_avail(page, slot, new_cat))
+				dirty = true;
+			if (blk == endBlk || slot == SlotsPerFSMPage - 1)
+				break;
+			blk++;
+			slot++;
+		}
+
+		if (dirty)
+			MarkBufferDirtyHint(buf, false);
+		max_avail = fsm_get_max_avail(page);
+		UnlockReleaseBuffer(buf);
+
+		fsm_update_parents(rel, addr, max_avail);
+
+		if (blk == endBlk)
+			break;
+		blk++;
+	}
+}
+
 /*
  * XLogRecordPageWithFreeSpace - like RecordPageWithFreeSpace, for use in
  *		WAL replay
@@ -633,6 +690,36 @@ fsm_set_and_search(Relation rel, FSMAddress addr, uint16 slot,
 	return newslot;
 }
 
+/*
+ * Propagate a change of the amount of free space on an FSM page up the tree
+ *
+ * value is the new maximum of the page at addr.  Each parent's slot for its
+ * child is set to the child's maximum, as FreeSpaceMapVacuum would, up to
+ * the root.
+ */
+static void
+fsm_update_parents(Relation rel, FSMAddress addr, uint8 value)
+{
+	while (addr.level != FSM_ROOT_LEVEL)
+	{
+		uint16		parentslot;
+		Buffer		buf;
+		Page		page;
+
+		addr = fsm_get_parent(addr, &parentslot);
+
+		buf = fsm_readbuf(rel, addr, true);
+		LockBuffer(buf, BUFFER_LOCK_EXCLUSIVE);
+		page = BufferGetPage(buf);
+
+		if (fsm_set_avail(page, parentslot, value))
+			MarkBufferDirtyHint(buf, false);
+		value = fsm_get_max_avail(page);
+
+		UnlockReleaseBuffer(buf);
+	}
+}
+
 /*
  * Search the tree for a heap page with at least min_cat of free space
  */
@@ -19,6 +19,7 @@
 #include "postgres.h"
 
 #include "miscadmin.h"
+#include "pgstat.h"
 #include "postmaster/bgworker.h"
 #include "storage/procsignal.h"
 #include "storage/shm_mq.h"
@@ -311,6 +312,15 @@ shm_mq_set_handle(shm_mq_handle *mqh, BackgroundWorkerHandle *handle)
 	mqh->mqh_handle = handle;
 }
 
+/*
+ * Get the shm_mq from handle.
+ */
+shm_mq *
+shm_mq_get_queue(shm_mq_handle *mqh)
+{
+	return mqh->mqh_queue;
+}
+
 /*
  * Write a message into a shared message queue.
  */
@@ -827,7 +837,9 @@ shm_mq_send_bytes(shm_mq_handle *mqh, Size nbytes, const void *data,
 			 * at top of loop, because setting an already-set latch is much
 			 * cheaper than setting one that has been reset.
 			 */
+			pgstat_report_wait_start(WAIT_EVENT_MQ_SEND);
 			WaitLatch(MyLatch, WL_LATCH_SET, 0);
+			pgstat_report_wait_end();
 
 			/* An interrupt may have occurred while we were waiting. */
 			CHECK_FOR_INTERRUPTS();
@@ -924,7 +936,9 @@ shm_mq_receive_bytes(shm_mq *mq, Size bytes_needed, bool nowait,
 		 * loop, because setting an already-set latch is much cheaper than
 		 * setting one that has been reset.
 		 */
+		pgstat_report_wait_start(WAIT_EVENT_MQ_RECEIVE);
 		WaitLatch(MyLatch, WL_LATCH_SET, 0);
+		pgstat_report_wait_end();
 
 		/* An interrupt may have occurred while we were waiting. */
 		CHECK_FOR_INTERRUPTS();
@@ -991,7 +1005,9 @@ shm_mq_wait_internal(volatile shm_mq *mq, PGPROC *volatile * ptr,
 			}
 
 			/* Wait to be signalled. */
+			pgstat_report_wait_start(WAIT_EVENT_MQ_INTERNAL);
 			WaitLatch(MyLatch, WL_LATCH_SET, 0);
+			pgstat_report_wait_end();
 
 			/* An interrupt may have occurred while we were waiting. */
 			CHECK_FOR_INTERRUPTS();
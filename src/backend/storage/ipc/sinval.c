@@ -21,6 +21,8 @@
 #include "storage/proc.h"
 #include "storage/sinvaladt.h"
 #include "utils/inval.h"
+#include "utils/sharedcatcache.h"
+#include "utils/sharedplancache.h"
 
 
 uint64		SharedInvalidMessageCounter;
@@ -48,6 +50,14 @@ volatile sig_atomic_t catchupInterruptPending = false;
 void
 SendSharedInvalidMessages(const SharedInvalidationMessage *msgs, int n)
 {
+	/*
+	 * Evict the affected entries from the shared catalog and plan caches
+	 * first, so that a backend acting on these messages can't find them
+	 * there again.
+	 */
+	SharedCatCacheProcessMessages(msgs, n);
+	SharedPlanCacheProcessMessages(msgs, n);
+
 	SIInsertDataEntries(msgs, n);
 }
 
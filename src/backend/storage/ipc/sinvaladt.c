@@ -26,6 +26,7 @@
 #include "storage/sinvaladt.h"
 #include "storage/spin.h"
 #include "access/transam.h"
+#include "utils/syscache.h"
 
 
 /*
@@ -45,14 +46,17 @@
  *
  * In reality, the messages are stored in a circular buffer of MAXNUMMESSAGES
  * entries.  We translate MsgNum values into circular-buffer indexes by
- * computing MsgNum % MAXNUMMESSAGES (this should be fast as long as
- * MAXNUMMESSAGES is a constant and a power of 2).  As long as maxMsgNum
- * doesn't exceed minMsgNum by more than MAXNUMMESSAGES, we have enough space
- * in the buffer.  If the buffer does overflow, we recover by setting the
- * "reset" flag for each backend that has fallen too far behind.  A backend
- * that is in "reset" state is ignored while determining minMsgNum.  When
- * it does finally attempt to receive inval messages, it must discard all
- * its invalidatable state, since it won't know what it missed.
+ * computing MsgNum & (MAXNUMMESSAGES - 1), which works because
+ * MAXNUMMESSAGES is a power of 2.  As long as maxMsgNum doesn't exceed
+ * minMsgNum by more than MAXNUMMESSAGES, we have enough space in the buffer.
+ * If the buffer does overflow, we recover by folding the messages that each
+ * backend that has fallen too far behind still needs into a small summary
+ * kept in its ProcState, which it reads before the rest of the queue (see
+ * SISummarizeMessages).  Only if the summary overflows too do we set the
+ * "reset" flag for the backend.  A backend that is in "reset" state is
+ * ignored while determining minMsgNum.  When it does finally attempt to
+ * receive inval messages, it must discard all its invalidatable state,
+ * since it won't know what it missed.
  *
  * To reduce the probability of needing resets, we send a "catchup" interrupt
  * to any backend that seems to be falling unreasonably far behind.  The
@@ -107,11 +111,12 @@
 /*
  * Configurable parameters.
  *
- * MAXNUMMESSAGES: max number of shared-inval messages we can buffer.
- * Must be a power of 2 for speed.
+ * MAXNUMMESSAGES: max number of shared-inval messages we can buffer.  This
+ * is shared_invalidation_queue_size rounded up to a power of 2.
  *
  * MSGNUMWRAPAROUND: how often to reduce MsgNum variables to avoid overflow.
- * Must be a multiple of MAXNUMMESSAGES.  Should be large.
+ * Must be a multiple of MAXNUMMESSAGES, which any power of 2 up to 2^30
+ * is.  Should be large.
  *
  * CLEANUP_MIN: the minimum number of messages that must be in the buffer
  * before we bother to call SICleanupQueue.
@@ -126,14 +131,18 @@
  * iteration of SIInsertDataEntries.  Noncritical but should be less than
  * CLEANUP_QUANTUM, because we only consider calling SICleanupQueue once
  * per iteration.
+ *
+ * SUMMARY_SIZE: the max number of messages in a backend's summary of the
+ * messages it missed.
  */
 
-#define MAXNUMMESSAGES 4096
-#define MSGNUMWRAPAROUND (MAXNUMMESSAGES * 262144)
+#define MAXNUMMESSAGES (shmInvalBuffer->numMessages)
+#define MSGNUMWRAPAROUND 0x40000000
 #define CLEANUP_MIN (MAXNUMMESSAGES / 2)
 #define CLEANUP_QUANTUM (MAXNUMMESSAGES / 16)
 #define SIG_THRESHOLD (MAXNUMMESSAGES / 2)
 #define WRITE_QUANTUM 64
+#define SUMMARY_SIZE 64
 
 /* Per-backend state in shared invalidation structure */
 typedef struct ProcState
@@ -155,6 +164,15 @@ typedef struct ProcState
 	 */
 	bool		sendOnly;		/* backend only sends, never receives */
 
+	/*
+	 * Messages that were removed from the queue before this backend read
+	 * them, in summarized form; see SISummarizeMessages.  The backend reads
+	 * these before any messages in the queue.  Meaningless if procPid == 0
+	 * or resetState is true.
+	 */
+	int			nsummary;		/* number of valid entries in summary[] */
+	SharedInvalidationMessage summary[SUMMARY_SIZE];
+
 	/*
 	 * Next LocalTransactionId to use for each idle backend slot.  We keep
 	 * this here because it is indexed by BackendId and it is convenient to
@@ -175,13 +193,14 @@ typedef struct SISeg
 	int			nextThreshold;	/* # of messages to call SICleanupQueue */
 	int			lastBackend;	/* index of last active procState entry, +1 */
 	int			maxBackends;	/* size of procState array */
+	int			numMessages;	/* size of buffer array, a power of 2 */
 
 	slock_t		msgnumLock;		/* spinlock protecting maxMsgNum */
 
 	/*
-	 * Circular buffer holding shared-inval messages
+	 * Circular buffer holding shared-inval messages (follows procState)
 	 */
-	SharedInvalidationMessage buffer[MAXNUMMESSAGES];
+	SharedInvalidationMessage *buffer;
 
 	/*
 	 * Per-backend invalidation state info (has MaxBackends entries).
@@ -191,24 +210,54 @@ typedef struct SISeg
 
 static SISeg *shmInvalBuffer;	/* pointer to the shared inval buffer */
 
+/* GUC variable */
+int			shared_invalidation_queue_size = 4096;
+
 
 static LocalTransactionId nextLocalTransactionId;
 
 static void CleanupInvalidationState(int status, Datum arg);
+static bool SISummarizeMessages(SISeg *segP, ProcState *stateP, int upto);
 
 
 /*
- * SInvalShmemSize --- return shared-memory space needed
+ * Size of the circular buffer: shared_invalidation_queue_size rounded up
+ * to a power of 2.
  */
-Size
-SInvalShmemSize(void)
+static int
+SInvalQueueSize(void)
+{
+	int			size = 1;
+
+	while (size < shared_invalidation_queue_size)
+		size <<= 1;
+
+	return size;
+}
+
+/*
+ * Offset of the circular buffer from the start of the SISeg.
+ */
+static Size
+SInvalBufferOffset(void)
 {
 	Size		size;
 
 	size = offsetof(SISeg, procState);
 	size = add_size(size, mul_size(sizeof(ProcState), MaxBackends));
 
-	return size;
+	return MAXALIGN(size);
+}
+
+/*
+ * SInvalShmemSize --- return shared-memory space needed
+ */
+Size
+SInvalShmemSize(void)
+{
+	return add_size(SInvalBufferOffset(),
+					mul_size(sizeof(SharedInvalidationMessage),
+							 SInvalQueueSize()));
 }
 
 /*
@@ -233,8 +282,12 @@ CreateSharedInvalidationState(void)
 	shmInvalBuffer->nextThreshold = CLEANUP_MIN;
 	shmInvalBuffer->lastBackend = 0;
 	shmInvalBuffer->maxBackends = MaxBackends;
+	shmInvalBuffer->numMessages = SInvalQueueSize();
 	SpinLockInit(&shmInvalBuffer->msgnumLock);
 
+	shmInvalBuffer->buffer = (SharedInvalidationMessage *)
+		((char *) shmInvalBuffer + SInvalBufferOffset());
+
 	/* The buffer[] array is initially all unused, so we need not fill it */
 
 	/* Mark all backends inactive, and initialize nextLXID */
@@ -246,6 +299,7 @@ CreateSharedInvalidationState(void)
 		shmInvalBuffer->procState[i].resetState = false;
 		shmInvalBuffer->procState[i].signaled = false;
 		shmInvalBuffer->procState[i].hasMessages = false;
+		shmInvalBuffer->procState[i].nsummary = 0;
 		shmInvalBuffer->procState[i].nextLXID = InvalidLocalTransactionId;
 	}
 }
@@ -315,6 +369,7 @@ SharedInvalBackendInit(bool sendOnly)
 	stateP->signaled = false;
 	stateP->hasMessages = false;
 	stateP->sendOnly = sendOnly;
+	stateP->nsummary = 0;
 
 	LWLockRelease(SInvalWriteLock);
 
@@ -354,6 +409,7 @@ CleanupInvalidationState(int status, Datum arg)
 	stateP->nextMsgNum = 0;
 	stateP->resetState = false;
 	stateP->signaled = false;
+	stateP->nsummary = 0;
 
 	/* Recompute index of last active backend */
 	for (i = segP->lastBackend; i > 0; i--)
@@ -480,7 +536,7 @@ SIInsertDataEntries(const SharedInvalidationMessage *data, int n)
 		max = segP->maxMsgNum;
 		while (nthistime-- > 0)
 		{
-			segP->buffer[max % MAXNUMMESSAGES] = *data++;
+			segP->buffer[max & (MAXNUMMESSAGES - 1)] = *data++;
 			max++;
 		}
 
@@ -598,10 +654,26 @@ SIGetDataEntries(SharedInvalidationMessage *data, int datasize)
 		stateP->nextMsgNum = max;
 		stateP->resetState = false;
 		stateP->signaled = false;
+		stateP->nsummary = 0;
 		LWLockRelease(SInvalReadLock);
 		return -1;
 	}
 
+	/*
+	 * The summary of any messages we missed comes first, since they precede
+	 * all the messages still in the queue.
+	 */
+	n = 0;
+	if (stateP->nsummary > 0)
+	{
+		n = Min(stateP->nsummary, datasize);
+		memcpy(data, stateP->summary, n * sizeof(SharedInvalidationMessage));
+		stateP->nsummary -= n;
+		if (stateP->nsummary > 0)
+			memmove(stateP->summary, stateP->summary + n,
+					stateP->nsummary * sizeof(SharedInvalidationMessage));
+	}
+
 	/*
 	 * Retrieve messages and advance backend's counter, until data array is
 	 * full or there are no more messages.
@@ -610,10 +682,9 @@ SIGetDataEntries(SharedInvalidationMessage *data, int datasize)
 	 * cannot delete them here.  SICleanupQueue() will eventually remove them
 	 * from the queue.
 	 */
-	n = 0;
 	while (n < datasize && stateP->nextMsgNum < max)
 	{
-		data[n++] = segP->buffer[stateP->nextMsgNum % MAXNUMMESSAGES];
+		data[n++] = segP->buffer[stateP->nextMsgNum & (MAXNUMMESSAGES - 1)];
 		stateP->nextMsgNum++;
 	}
 
@@ -624,7 +695,7 @@ SIGetDataEntries(SharedInvalidationMessage *data, int datasize)
 	 * If we haven't caught up completely, reset the hasMessages flag so that
 	 * we see the remaining messages next time.
 	 */
-	if (stateP->nextMsgNum >= max)
+	if (stateP->nextMsgNum >= max && stateP->nsummary == 0)
 		stateP->signaled = false;
 	else
 		stateP->hasMessages = true;
@@ -640,8 +711,9 @@ SIGetDataEntries(SharedInvalidationMessage *data, int datasize)
  * callerHasWriteLock is TRUE if caller is holding SInvalWriteLock.
  * minFree is the minimum number of message slots to make free.
  *
- * Possible side effects of this routine include marking one or more
- * backends as "reset" in the array, and sending PROCSIG_CATCHUP_INTERRUPT
+ * Possible side effects of this routine include summarizing the unread
+ * messages of one or more backends, or marking them as "reset" in the
+ * array if that fails, and sending PROCSIG_CATCHUP_INTERRUPT
  * to some backend that seems to be getting too far behind.  We signal at
  * most one backend at a time, for reasons explained at the top of the file.
  *
@@ -667,8 +739,8 @@ SICleanupQueue(bool callerHasWriteLock, int minFree)
 
 	/*
 	 * Recompute minMsgNum = minimum of all backends' nextMsgNum, identify the
-	 * furthest-back backend that needs signaling (if any), and reset any
-	 * backends that are too far back.  Note that because we ignore sendOnly
+	 * furthest-back backend that needs signaling (if any), and summarize or
+	 * reset any backends that are too far back.  Note that because we ignore sendOnly
 	 * backends here it is possible for them to keep sending messages without
 	 * a problem even when they are the only active backend.
 	 */
@@ -686,14 +758,19 @@ SICleanupQueue(bool callerHasWriteLock, int minFree)
 			continue;
 
 		/*
-		 * If we must free some space and this backend is preventing it, force
-		 * him into reset state and then ignore until he catches up.
+		 * If we must free some space and this backend is preventing it, fold
+		 * the messages in the way into his summary.  If that fails, force him
+		 * into reset state and then ignore until he catches up.
 		 */
 		if (n < lowbound)
 		{
-			stateP->resetState = true;
-			/* no point in signaling him ... */
-			continue;
+			if (!SISummarizeMessages(segP, stateP, lowbound))
+			{
+				stateP->resetState = true;
+				/* no point in signaling him ... */
+				continue;
+			}
+			n = stateP->nextMsgNum;
 		}
 
 		/* Track the global minimum nextMsgNum */
@@ -761,6 +838,129 @@ SICleanupQueue(bool callerHasWriteLock, int minFree)
 	}
 }
 
+/*
+ * SIMessagesEqual
+ *		Do two messages have the same effect on the receiving backend?
+ */
+static bool
+SIMessagesEqual(const SharedInvalidationMessage *a,
+				const SharedInvalidationMessage *b)
+{
+	if (a->id != b->id)
+		return false;
+
+	switch (a->id)
+	{
+		case SHAREDINVALCATALOG_ID:
+			return a->cat.dbId == b->cat.dbId && a->cat.catId == b->cat.catId;
+		case SHAREDINVALRELCACHE_ID:
+			return a->rc.dbId == b->rc.dbId && a->rc.relId == b->rc.relId;
+		case SHAREDINVALSMGR_ID:
+			return a->sm.backend_hi == b->sm.backend_hi &&
+				a->sm.backend_lo == b->sm.backend_lo &&
+				RelFileNodeEquals(a->sm.rnode, b->sm.rnode);
+		case SHAREDINVALRELMAP_ID:
+			return a->rm.dbId == b->rm.dbId;
+		case SHAREDINVALSNAPSHOT_ID:
+			/* the receiver only looks at the database */
+			return a->sn.dbId == b->sn.dbId;
+		default:
+			return false;
+	}
+}
+
+/*
+ * SISummarizeMessages
+ *		Fold the messages a backend hasn't read yet, up to message number
+ *		"upto", into its summary, so that they can be removed from the queue.
+ *
+ * The summary keeps what the backend needs to invalidate, in a coarser
+ * form: a catcache message becomes a message to flush all the caches on
+ * its catalog, duplicates are dropped, and so are messages concerning
+ * other databases, which the backend would ignore anyway.  (Except smgr
+ * messages, which the receiver acts on whatever the database.)  So a
+ * backend that falls behind while lots of rows of a few catalogs change,
+ * or while another database sees a lot of DDL, gets away with flushing
+ * just what changed, instead of all of its caches.
+ *
+ * Returns false if the summary would overflow, or if we don't know the
+ * backend's database yet; the caller must then reset the backend.  The
+ * caller must hold SInvalReadLock exclusively.
+ */
+static bool
+SISummarizeMessages(SISeg *segP, ProcState *stateP, int upto)
+{
+	Oid			dbId;
+	int			nsummary = stateP->nsummary;
+	int			n;
+
+	dbId = stateP->proc != NULL ? stateP->proc->databaseId : InvalidOid;
+	if (!OidIsValid(dbId))
+		return false;
+
+	for (n = stateP->nextMsgNum; n < upto; n++)
+	{
+		SharedInvalidationMessage msg;
+		Oid			msgDbId;
+		int			i;
+
+		msg = segP->buffer[n & (MAXNUMMESSAGES - 1)];
+
+		if (msg.id >= 0)
+		{
+			Oid			catId = GetSysCacheRelationId(msg.cc.id);
+
+			if (!OidIsValid(catId))
+				return false;
+			msgDbId = msg.cc.dbId;
+			msg.cat.id = SHAREDINVALCATALOG_ID;
+			msg.cat.dbId = msgDbId;
+			msg.cat.catId = catId;
+		}
+
+		switch (msg.id)
+		{
+			case SHAREDINVALCATALOG_ID:
+				msgDbId = msg.cat.dbId;
+				break;
+			case SHAREDINVALRELCACHE_ID:
+				msgDbId = msg.rc.dbId;
+				break;
+			case SHAREDINVALSMGR_ID:
+				msgDbId = InvalidOid;
+				break;
+			case SHAREDINVALRELMAP_ID:
+				msgDbId = msg.rm.dbId;
+				break;
+			case SHAREDINVALSNAPSHOT_ID:
+				msgDbId = msg.sn.dbId;
+				break;
+			default:
+				return false;
+		}
+		if (OidIsValid(msgDbId) && msgDbId != dbId)
+			continue;
+
+		for (i = 0; i < nsummary; i++)
+		{
+			if (SIMessagesEqual(&stateP->summary[i], &msg))
+				break;
+		}
+		if (i < nsummary)
+			continue;
+
+		if (nsummary >= SUMMARY_SIZE)
+			return false;
+		stateP->summary[nsummary++] = msg;
+	}
+
+	stateP->nsummary = nsummary;
+	stateP->nextMsgNum = upto;
+	stateP->hasMessages = true;
+
+	return true;
+}
+
 
 /*
  * GetNextLocalTransactionId --- allocate a new LocalTransactionId
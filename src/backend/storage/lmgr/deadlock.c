@@ -287,6 +287,81 @@ GetBlockingAutoVacuumPgproc(void)
 	return ptr;
 }
 
+/*
+ * DeadLockCheckNeeded -- cheap test whether a full DeadLockCheck is needed
+ *
+ * A deadlock cycle through "proc" must leave it by one of its outgoing
+ * waits-for edges.  If none of the processes hard-blocking it is itself
+ * waiting for a lock, and no conflicting request is queued ahead of it,
+ * there is no such edge to follow and "proc" cannot be part of a cycle,
+ * hard or soft.  If one of the blockers later starts to wait and closes a
+ * cycle, that process' own deadlock check will find it.
+ *
+ * We also report "needed" if an autovacuum worker hard-blocks "proc", so
+ * that the full check gets to tell the caller about it.
+ *
+ * The caller must hold the partition lock of the lock "proc" waits for,
+ * but not all the partition locks; the whole point is to avoid taking those
+ * when there are many waiters but no deadlock.  We look at the blockers'
+ * waitLock fields without holding the partition locks protecting them.
+ * That's OK: a blocker we see as not waiting, but which starts waiting right
+ * afterwards, is one that will run its own deadlock check later.
+ */
+bool
+DeadLockCheckNeeded(PGPROC *proc)
+{
+	LOCK	   *lock = proc->waitLock;
+	LockMethod	lockMethodTable;
+	PROC_QUEUE *waitQueue;
+	SHM_QUEUE  *procLocks;
+	PROCLOCK   *proclock;
+	PGPROC	   *blocker;
+	int			conflictMask;
+	int			queue_size;
+
+	/* Not waiting anymore, nothing to check */
+	if (lock == NULL || proc->links.next == NULL)
+		return false;
+
+	lockMethodTable = GetLocksMethodTable(lock);
+	conflictMask = lockMethodTable->conflictTab[proc->waitLockMode];
+
+	/* Check the procs holding conflicting locks, cf FindLockCycleRecurse */
+	procLocks = &(lock->procLocks);
+	proclock = (PROCLOCK *) SHMQueueNext(procLocks, procLocks,
+										 offsetof(PROCLOCK, lockLink));
+	while (proclock)
+	{
+		blocker = proclock->tag.myProc;
+
+		if (blocker != proc && (proclock->holdMask & conflictMask) != 0)
+		{
+			PGXACT	   *pgxact = &ProcGlobal->allPgXact[blocker->pgprocno];
+
+			if (blocker->waitLock != NULL)
+				return true;
+			if (pgxact->vacuumFlags & PROC_IS_AUTOVACUUM)
+				return true;
+		}
+
+		proclock = (PROCLOCK *) SHMQueueNext(procLocks, &proclock->lockLink,
+											 offsetof(PROCLOCK, lockLink));
+	}
+
+	/* Any conflicting request ahead of us in the queue is a soft edge */
+	waitQueue = &(lock->waitProcs);
+	queue_size = waitQueue->size;
+	blocker = (PGPROC *) waitQueue->links.next;
+	while (queue_size-- > 0 && blocker != proc)
+	{
+		if (((1 << blocker->waitLockMode) & conflictMask) != 0)
+			return true;
+		blocker = (PGPROC *) blocker->links.next;
+	}
+
+	return false;
+}
+
 /*
  * DeadLockCheckRecurse -- recursively search for valid orderings
  *
@@ -81,6 +81,8 @@
 #include "commands/async.h"
 #include "miscadmin.h"
 #include "pg_trace.h"
+#include "pgstat.h"
+#include "portability/instr_time.h"
 #include "postmaster/postmaster.h"
 #include "replication/slot.h"
 #include "storage/ipc.h"
@@ -150,6 +152,32 @@ static LWLockHandle held_lwlocks[MAX_SIMUL_LWLOCKS];
 static int	lock_addin_request = 0;
 static bool lock_addin_request_allowed = true;
 
+/*
+ * Cumulative contention statistics.
+ *
+ * Every process that has a PGPROC counts acquisitions, blocks, time spent
+ * blocked and spin delays into its own set of counters in shared memory,
+ * so updating them needs no locking and causes no cache line contention.
+ * The counters of a PGPROC slot survive the exit of the process using it,
+ * so the totals are simply the sum over all slots.  Until InitLWLockAccess
+ * is called, a process counts into a local dummy set instead.
+ *
+ * There is a set of counters for each individual lock and each partition of
+ * the partitioned locks in the main array, one for the rest of the main
+ * array, and one for each tranche up to LWLOCK_STATS_TRANCHES; higher
+ * tranche IDs share the last one.
+ */
+#define LWLOCK_STATS_TRANCHES		32
+#define LWLOCK_STATS_MAIN_SLOT		NUM_FIXED_LWLOCKS
+#define NUM_LWLOCK_STATS_SLOTS		(NUM_FIXED_LWLOCKS + 1 + LWLOCK_STATS_TRANCHES)
+
+static LWLockStatsCounters *LWLockStatsArray = NULL;
+static LWLockStatsCounters LocalLWLockStats[NUM_LWLOCK_STATS_SLOTS];
+static LWLockStatsCounters *MyLWLockStats = LocalLWLockStats;
+
+/* start of the current sleep, for the wait time counter */
+static instr_time lwlock_wait_start;
+
 static inline bool LWLockAcquireCommon(LWLock *l, LWLockMode mode,
 					uint64 *valptr, uint64 val);
 
@@ -318,6 +346,54 @@ get_lwlock_stats_entry(LWLock *lock)
 #endif   /* LWLOCK_STATS */
 
 
+/*
+ * Names of the individual LWLocks in the main array, for wait event
+ * reporting.  This must match the list in lwlock.h!
+ */
+static const char *const MainLWLockNames[] = {
+	"unused",
+	"ShmemIndexLock",
+	"OidGenLock",
+	"XidGenLock",
+	"ProcArrayLock",
+	"SInvalReadLock",
+	"SInvalWriteLock",
+	"WALBufMappingLock",
+	"WALWriteLock",
+	"ControlFileLock",
+	"CheckpointLock",
+	"CLogControlLock",
+	"SubtransControlLock",
+	"MultiXactGenLock",
+	"MultiXactOffsetControlLock",
+	"MultiXactMemberControlLock",
+	"RelCacheInitLock",
+	"CheckpointerCommLock",
+	"TwoPhaseStateLock",
+	"TablespaceCreateLock",
+	"BtreeVacuumLock",
+	"AddinShmemInitLock",
+	"AutovacuumLock",
+	"AutovacuumScheduleLock",
+	"SyncScanLock",
+	"RelationMappingLock",
+	"AsyncCtlLock",
+	"AsyncQueueLock",
+	"SerializableXactHashLock",
+	"SerializableFinishedListLock",
+	"SerializablePredicateLockListLock",
+	"OldSerXidLock",
+	"SyncRepLock",
+	"BackgroundWorkerLock",
+	"DynamicSharedMemoryControlLock",
+	"AutoFileLock",
+	"ReplicationSlotAllocationLock",
+	"ReplicationSlotControlLock",
+	"CommitTsControlLock",
+	"CommitTsLock",
+	"ReplicationOriginLock"
+};
+
 /*
  * Compute number of LWLocks to allocate in the main array.
  */
@@ -349,13 +425,13 @@ NumLWLocks(void)
 	numLocks += CommitTsShmemBuffers();
 
 	/* subtrans.c needs one per SubTrans buffer */
-	numLocks += NUM_SUBTRANS_BUFFERS;
+	numLocks += subtransaction_buffers;
 
 	/* multixact.c needs two SLRU areas */
-	numLocks += NUM_MXACTOFFSET_BUFFERS + NUM_MXACTMEMBER_BUFFERS;
+	numLocks += multixact_offset_buffers + multixact_member_buffers;
 
 	/* async.c needs one per Async buffer */
-	numLocks += NUM_ASYNC_BUFFERS;
+	numLocks += notify_buffers;
 
 	/* predicate.c needs one per old serializable xid buffer */
 	numLocks += NUM_OLDSERXID_BUFFERS;
@@ -410,6 +486,11 @@ LWLockShmemSize(void)
 	/* Space for dynamic allocation counter, plus room for alignment. */
 	size = add_size(size, 3 * sizeof(int) + LWLOCK_PADDED_SIZE);
 
+	/* Space for the statistics counters of each possible process. */
+	size = add_size(size, mul_size(mul_size(MaxBackends + NUM_AUXILIARY_PROCS,
+											NUM_LWLOCK_STATS_SLOTS),
+								   sizeof(LWLockStatsCounters)));
+
 	return size;
 }
 
@@ -459,13 +540,20 @@ CreateLWLocks(void)
 		LWLockCounter[0] = NUM_FIXED_LWLOCKS;
 		LWLockCounter[1] = numLocks;
 		LWLockCounter[2] = 1;	/* 0 is the main array */
+
+		/* The statistics counters follow the main array */
+		LWLockStatsArray = (LWLockStatsCounters *) (MainLWLockArray + numLocks);
+		MemSet(LWLockStatsArray, 0,
+			   mul_size(mul_size(MaxBackends + NUM_AUXILIARY_PROCS,
+								 NUM_LWLOCK_STATS_SLOTS),
+						sizeof(LWLockStatsCounters)));
 	}
 
 	if (LWLockTrancheArray == NULL)
 	{
 		LWLockTranchesAllocated = 16;
 		LWLockTrancheArray = (LWLockTranche **)
-			MemoryContextAlloc(TopMemoryContext,
+			MemoryContextAllocZero(TopMemoryContext,
 						  LWLockTranchesAllocated * sizeof(LWLockTranche *));
 	}
 
@@ -481,6 +569,20 @@ CreateLWLocks(void)
 void
 InitLWLockAccess(void)
 {
+	Assert(MyProc != NULL &&
+		   MyProc->pgprocno < MaxBackends + NUM_AUXILIARY_PROCS);
+
+	if (LWLockStatsArray == NULL)
+	{
+		int		   *LWLockCounter;
+
+		/* Same calculation as in CreateLWLocks, for EXEC_BACKEND */
+		LWLockCounter = (int *) ((char *) MainLWLockArray - 3 * sizeof(int));
+		LWLockStatsArray = (LWLockStatsCounters *)
+			(MainLWLockArray + LWLockCounter[1]);
+	}
+	MyLWLockStats = &LWLockStatsArray[MyProc->pgprocno * NUM_LWLOCK_STATS_SLOTS];
+
 #ifdef LWLOCK_STATS
 	init_lwlock_stats();
 #endif
@@ -550,6 +652,8 @@ LWLockRegisterTranche(int tranche_id, LWLockTranche *tranche)
 		LWLockTrancheArray = (LWLockTranche **)
 			repalloc(LWLockTrancheArray,
 					 i * sizeof(LWLockTranche *));
+		memset(&LWLockTrancheArray[LWLockTranchesAllocated], 0,
+			   (i - LWLockTranchesAllocated) * sizeof(LWLockTranche *));
 		LWLockTranchesAllocated = i;
 	}
 
@@ -571,6 +675,210 @@ LWLockInitialize(LWLock *lock, int tranche_id)
 	dlist_init(&lock->waiters);
 }
 
+/*
+ * Return this process's statistics counters for the given lock.
+ */
+static inline LWLockStatsCounters *
+LWLockStatsEntry(LWLock *lock)
+{
+	if (lock->tranche == 0)
+	{
+		uintptr_t	id = (LWLockPadded *) lock - MainLWLockArray;
+
+		if (id < NUM_FIXED_LWLOCKS)
+			return &MyLWLockStats[id];
+		return &MyLWLockStats[LWLOCK_STATS_MAIN_SLOT];
+	}
+
+	return &MyLWLockStats[LWLOCK_STATS_MAIN_SLOT +
+						  Min(lock->tranche, LWLOCK_STATS_TRANCHES)];
+}
+
+/*
+ * Acquire the spinlock protecting the lock's wait list, counting any spin
+ * delays.  Returns the number of delays, like SpinLockAcquire.
+ */
+static inline int
+LWLockAcquireMutex(LWLock *lock)
+{
+	int			delays = SpinLockAcquire(&lock->mutex);
+
+	if (delays > 0)
+		LWLockStatsEntry(lock)->spin_delay_count += delays;
+	return delays;
+}
+
+/*
+ * Report that we're about to sleep on the given lock.
+ *
+ * Individual locks in the main array are reported by their number there,
+ * and partitioned locks by the number of their first partition; anything
+ * else by its tranche.
+ */
+static inline void
+LWLockReportWaitStart(LWLock *lock)
+{
+	LWLockStatsEntry(lock)->block_count++;
+	INSTR_TIME_SET_CURRENT(lwlock_wait_start);
+
+	if (lock->tranche == 0)
+	{
+		int			id = T_ID(lock);
+
+		if (id >= PREDICATELOCK_MANAGER_LWLOCK_OFFSET &&
+			id < NUM_FIXED_LWLOCKS)
+			id = PREDICATELOCK_MANAGER_LWLOCK_OFFSET;
+		else if (id >= LOCK_MANAGER_LWLOCK_OFFSET &&
+				 id < PREDICATELOCK_MANAGER_LWLOCK_OFFSET)
+			id = LOCK_MANAGER_LWLOCK_OFFSET;
+		else if (id >= BUFFER_MAPPING_LWLOCK_OFFSET &&
+				 id < LOCK_MANAGER_LWLOCK_OFFSET)
+			id = BUFFER_MAPPING_LWLOCK_OFFSET;
+
+		if (id < NUM_FIXED_LWLOCKS)
+		{
+			pgstat_report_wait_start(PG_WAIT_LWLOCK_NAMED | (uint32) id);
+			return;
+		}
+	}
+
+	pgstat_report_wait_start(PG_WAIT_LWLOCK_TRANCHE | lock->tranche);
+}
+
+/*
+ * Report that we're done sleeping on a lock.
+ */
+static inline void
+LWLockReportWaitEnd(LWLock *lock)
+{
+	instr_time	wait_time;
+
+	INSTR_TIME_SET_CURRENT(wait_time);
+	INSTR_TIME_SUBTRACT(wait_time, lwlock_wait_start);
+	LWLockStatsEntry(lock)->wait_time += INSTR_TIME_GET_MICROSEC(wait_time);
+
+	pgstat_report_wait_end();
+}
+
+/*
+ * Return the name of an LWLock wait event, as reported by
+ * LWLockReportWaitStart().
+ *
+ * Tranches are registered per-process, so we might not know the name of
+ * one some other process is waiting on.
+ */
+const char *
+GetLWLockIdentifier(uint32 classId, uint16 eventId)
+{
+	StaticAssertStmt(lengthof(MainLWLockNames) == NUM_INDIVIDUAL_LWLOCKS,
+					 "MainLWLockNames[] must match NUM_INDIVIDUAL_LWLOCKS");
+
+	if (classId == PG_WAIT_LWLOCK_NAMED)
+	{
+		if (eventId < NUM_INDIVIDUAL_LWLOCKS)
+			return MainLWLockNames[eventId];
+		if (eventId == BUFFER_MAPPING_LWLOCK_OFFSET)
+			return "BufferMappingLock";
+		if (eventId == LOCK_MANAGER_LWLOCK_OFFSET)
+			return "LockManagerLock";
+		if (eventId == PREDICATELOCK_MANAGER_LWLOCK_OFFSET)
+			return "PredicateLockManagerLock";
+		return "unknown";
+	}
+
+	Assert(classId == PG_WAIT_LWLOCK_TRANCHE);
+	if (eventId >= LWLockTranchesAllocated ||
+		LWLockTrancheArray[eventId] == NULL)
+		return "extension";
+
+	return LWLockTrancheArray[eventId]->name;
+}
+
+/*
+ * GetLWLockStatsData - return the cumulative LWLock statistics
+ *
+ * Returns a palloc'd array with one entry for each individual lock and
+ * lock partition in the main array, one for the rest of the main array,
+ * and one for each other tranche that has seen any use; the number of
+ * entries is stored into *nelements.
+ *
+ * The counters are read without any locking, so the totals aren't an exact
+ * snapshot of any single moment.
+ */
+LWLockStatsData *
+GetLWLockStatsData(int *nelements)
+{
+	LWLockStatsData *result;
+	int			nprocs = MaxBackends + NUM_AUXILIARY_PROCS;
+	int			n = 0;
+	int			slot;
+
+	result = (LWLockStatsData *)
+		palloc(NUM_LWLOCK_STATS_SLOTS * sizeof(LWLockStatsData));
+
+	/* Slot 0 of the main array is unused, so start at 1 */
+	for (slot = 1; slot < NUM_LWLOCK_STATS_SLOTS; slot++)
+	{
+		LWLockStatsData *entry = &result[n];
+		LWLockStatsCounters *counters = &entry->counters;
+		int			i;
+
+		MemSet(entry, 0, sizeof(LWLockStatsData));
+		for (i = 0; i < nprocs; i++)
+		{
+			volatile LWLockStatsCounters *c;
+
+			c = &LWLockStatsArray[i * NUM_LWLOCK_STATS_SLOTS + slot];
+			counters->sh_acquire_count += c->sh_acquire_count;
+			counters->ex_acquire_count += c->ex_acquire_count;
+			counters->block_count += c->block_count;
+			counters->wait_time += c->wait_time;
+			counters->spin_delay_count += c->spin_delay_count;
+		}
+
+		entry->partition = -1;
+		if (slot < NUM_INDIVIDUAL_LWLOCKS)
+			entry->name = MainLWLockNames[slot];
+		else if (slot < LOCK_MANAGER_LWLOCK_OFFSET)
+		{
+			entry->name = "BufferMappingLock";
+			entry->partition = slot - BUFFER_MAPPING_LWLOCK_OFFSET;
+		}
+		else if (slot < PREDICATELOCK_MANAGER_LWLOCK_OFFSET)
+		{
+			entry->name = "LockManagerLock";
+			entry->partition = slot - LOCK_MANAGER_LWLOCK_OFFSET;
+		}
+		else if (slot < NUM_FIXED_LWLOCKS)
+		{
+			entry->name = "PredicateLockManagerLock";
+			entry->partition = slot - PREDICATELOCK_MANAGER_LWLOCK_OFFSET;
+		}
+		else if (slot == LWLOCK_STATS_MAIN_SLOT)
+			entry->name = "main";
+		else
+		{
+			int			tranche = slot - LWLOCK_STATS_MAIN_SLOT;
+
+			/* Skip tranches that have never been used */
+			if (counters->sh_acquire_count == 0 &&
+				counters->ex_acquire_count == 0)
+				continue;
+
+			if (tranche == LWLOCK_STATS_TRANCHES)
+				entry->name = "other";
+			else
+				entry->name = GetLWLockIdentifier(PG_WAIT_LWLOCK_TRANCHE,
+												  (uint16) tranche);
+		}
+
+		n++;
+	}
+
+	*nelements = n;
+	return result;
+}
+
 /*
  * Internal function that tries to atomically acquire the lwlock in the passed
  * in mode.
@@ -661,9 +969,9 @@ LWLockWakeup(LWLock *lock)
 
 	/* Acquire mutex.  Time spent holding mutex should be short! */
 #ifdef LWLOCK_STATS
-	lwstats->spin_delay_count += SpinLockAcquire(&lock->mutex);
+	lwstats->spin_delay_count += LWLockAcquireMutex(lock);
 #else
-	SpinLockAcquire(&lock->mutex);
+	LWLockAcquireMutex(lock);
 #endif
 
 	dlist_foreach_modify(iter, &lock->waiters)
@@ -765,9 +1073,9 @@ LWLockQueueSelf(LWLock *lock, LWLockMode mode)
 		elog(PANIC, "queueing for lock while waiting on another one");
 
 #ifdef LWLOCK_STATS
-	lwstats->spin_delay_count += SpinLockAcquire(&lock->mutex);
+	lwstats->spin_delay_count += LWLockAcquireMutex(lock);
 #else
-	SpinLockAcquire(&lock->mutex);
+	LWLockAcquireMutex(lock);
 #endif
 
 	/* setting the flag is protected by the spinlock */
@@ -814,9 +1122,9 @@ LWLockDequeueSelf(LWLock *lock)
 #endif
 
 #ifdef LWLOCK_STATS
-	lwstats->spin_delay_count += SpinLockAcquire(&lock->mutex);
+	lwstats->spin_delay_count += LWLockAcquireMutex(lock);
 #else
-	SpinLockAcquire(&lock->mutex);
+	LWLockAcquireMutex(lock);
 #endif
 
 	/*
@@ -933,8 +1241,12 @@ LWLockAcquireCommon(LWLock *lock, LWLockMode mode, uint64 *valptr, uint64 val)
 
 	PRINT_LWDEBUG("LWLockAcquire", lock, mode);
 
-#ifdef LWLOCK_STATS
 	/* Count lock acquisition attempts */
+	if (mode == LW_EXCLUSIVE)
+		LWLockStatsEntry(lock)->ex_acquire_count++;
+	else
+		LWLockStatsEntry(lock)->sh_acquire_count++;
+#ifdef LWLOCK_STATS
 	if (mode == LW_EXCLUSIVE)
 		lwstats->ex_acquire_count++;
 	else
@@ -1035,6 +1347,7 @@ LWLockAcquireCommon(LWLock *lock, LWLockMode mode, uint64 *valptr, uint64 val)
 		lwstats->block_count++;
 #endif
 
+		LWLockReportWaitStart(lock);
 		TRACE_POSTGRESQL_LWLOCK_WAIT_START(T_NAME(lock), T_ID(lock), mode);
 
 		for (;;)
@@ -1057,6 +1370,7 @@ LWLockAcquireCommon(LWLock *lock, LWLockMode mode, uint64 *valptr, uint64 val)
 		}
 #endif
 
+		LWLockReportWaitEnd(lock);
 		TRACE_POSTGRESQL_LWLOCK_WAIT_DONE(T_NAME(lock), T_ID(lock), mode);
 
 		LOG_LWDEBUG("LWLockAcquire", lock, "awakened");
@@ -1124,6 +1438,11 @@ LWLockConditionalAcquire(LWLock *lock, LWLockMode mode)
 	}
 	else
 	{
+		if (mode == LW_EXCLUSIVE)
+			LWLockStatsEntry(lock)->ex_acquire_count++;
+		else
+			LWLockStatsEntry(lock)->sh_acquire_count++;
+
 		/* Add lock to list of locks held by this backend */
 		held_lwlocks[num_held_lwlocks].lock = lock;
 		held_lwlocks[num_held_lwlocks++].mode = mode;
@@ -1162,6 +1481,11 @@ LWLockAcquireOrWait(LWLock *lock, LWLockMode mode)
 
 	PRINT_LWDEBUG("LWLockAcquireOrWait", lock, mode);
 
+	if (mode == LW_EXCLUSIVE)
+		LWLockStatsEntry(lock)->ex_acquire_count++;
+	else
+		LWLockStatsEntry(lock)->sh_acquire_count++;
+
 	/* Ensure we will have room to remember the lock */
 	if (num_held_lwlocks >= MAX_SIMUL_LWLOCKS)
 		elog(ERROR, "too many LWLocks taken");
@@ -1197,6 +1521,7 @@ LWLockAcquireOrWait(LWLock *lock, LWLockMode mode)
 #ifdef LWLOCK_STATS
 			lwstats->block_count++;
 #endif
+			LWLockReportWaitStart(lock);
 			TRACE_POSTGRESQL_LWLOCK_WAIT_START(T_NAME(lock), T_ID(lock), mode);
 
 			for (;;)
@@ -1215,6 +1540,7 @@ LWLockAcquireOrWait(LWLock *lock, LWLockMode mode)
 				Assert(nwaiters < MAX_BACKENDS);
 			}
 #endif
+			LWLockReportWaitEnd(lock);
 			TRACE_POSTGRESQL_LWLOCK_WAIT_DONE(T_NAME(lock), T_ID(lock), mode);
 
 			LOG_LWDEBUG("LWLockAcquireOrWait", lock, "awakened");
@@ -1325,9 +1651,9 @@ LWLockWaitForVar(LWLock *lock, uint64 *valptr, uint64 oldval, uint64 *newval)
 			 * bit reads/stores.
 			 */
 #ifdef LWLOCK_STATS
-			lwstats->spin_delay_count += SpinLockAcquire(&lock->mutex);
+			lwstats->spin_delay_count += LWLockAcquireMutex(lock);
 #else
-			SpinLockAcquire(&lock->mutex);
+			LWLockAcquireMutex(lock);
 #endif
 
 			/*
@@ -1398,6 +1724,7 @@ LWLockWaitForVar(LWLock *lock, uint64 *valptr, uint64 oldval, uint64 *newval)
 		lwstats->block_count++;
 #endif
 
+		LWLockReportWaitStart(lock);
 		TRACE_POSTGRESQL_LWLOCK_WAIT_START(T_NAME(lock), T_ID(lock),
 										   LW_EXCLUSIVE);
 
@@ -1418,6 +1745,7 @@ LWLockWaitForVar(LWLock *lock, uint64 *valptr, uint64 oldval, uint64 *newval)
 		}
 #endif
 
+		LWLockReportWaitEnd(lock);
 		TRACE_POSTGRESQL_LWLOCK_WAIT_DONE(T_NAME(lock), T_ID(lock),
 										  LW_EXCLUSIVE);
 
@@ -1470,9 +1798,9 @@ LWLockUpdateVar(LWLock *lock, uint64 *valptr, uint64 val)
 
 	/* Acquire mutex.  Time spent holding mutex should be short! */
 #ifdef LWLOCK_STATS
-	lwstats->spin_delay_count += SpinLockAcquire(&lock->mutex);
+	lwstats->spin_delay_count += LWLockAcquireMutex(lock);
 #else
-	SpinLockAcquire(&lock->mutex);
+	LWLockAcquireMutex(lock);
 #endif
 
 	Assert(pg_atomic_read_u32(&lock->state) & LW_VAL_EXCLUSIVE);
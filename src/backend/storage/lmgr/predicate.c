@@ -354,6 +354,10 @@ static SERIALIZABLEXACT *OldCommittedSxact;
 /* This configuration variable is used to set the predicate lock table size */
 int			max_predicate_locks_per_xact;		/* set by guc.c */
 
+/* These configuration variables are used to set the promotion thresholds */
+int			max_predicate_locks_per_relation;	/* set by guc.c */
+int			max_predicate_locks_per_page;		/* set by guc.c */
+
 /*
  * This provides a list of objects in order to track transactions
  * participating in predicate locking.  Entries in the list are fixed size,
@@ -2129,16 +2133,15 @@ DeleteChildTargetLocks(const PREDICATELOCKTARGETTAG *newtargettag)
 
 /*
  * Returns the promotion threshold for a given predicate lock
- * target. This is the number of descendant locks required to promote
- * to the specified tag. Note that the threshold includes non-direct
- * descendants, e.g. both tuples and pages for a relation lock.
+ * target. This is the number of descendant locks a transaction may hold
+ * before they are promoted to the specified tag. Note that the threshold
+ * includes non-direct descendants, e.g. both tuples and pages for a
+ * relation lock.
  *
- * TODO SSI: We should do something more intelligent about what the
- * thresholds are, either making it proportional to the number of
- * tuples in a page & pages in a relation, or at least making it a
- * GUC. Currently the threshold is 3 for a page lock, and
- * max_pred_locks_per_transaction/2 for a relation lock, chosen
- * entirely arbitrarily (and without benchmarking).
+ * The thresholds are set by max_pred_locks_per_relation and
+ * max_pred_locks_per_page.  A negative max_pred_locks_per_relation sets the
+ * relation threshold to max_pred_locks_per_transaction divided by its
+ * absolute value, so that it follows the size of the lock table.
  */
 static int
 PredicateLockPromotionThreshold(const PREDICATELOCKTARGETTAG *tag)
@@ -2146,10 +2149,13 @@ PredicateLockPromotionThreshold(const PREDICATELOCKTARGETTAG *tag)
 	switch (GET_PREDICATELOCKTARGETTAG_TYPE(*tag))
 	{
 		case PREDLOCKTAG_RELATION:
-			return max_predicate_locks_per_xact / 2;
+			return max_predicate_locks_per_relation < 0
+				? (max_predicate_locks_per_xact
+				   / -max_predicate_locks_per_relation) - 1
+				: max_predicate_locks_per_relation;
 
 		case PREDLOCKTAG_PAGE:
-			return 3;
+			return max_predicate_locks_per_page;
 
 		case PREDLOCKTAG_TUPLE:
 
@@ -2204,7 +2210,7 @@ CheckAndPromotePredicateLockRequest(const PREDICATELOCKTARGETTAG *reqtag)
 		else
 			parentlock->childLocks++;
 
-		if (parentlock->childLocks >=
+		if (parentlock->childLocks >
 			PredicateLockPromotionThreshold(&targettag))
 		{
 			/*
@@ -4081,6 +4087,7 @@ CheckTargetForConflictsIn(PREDICATELOCKTARGETTAG *targettag)
 	PREDICATELOCK *predlock;
 	PREDICATELOCK *mypredlock = NULL;
 	PREDICATELOCKTAG mypredlocktag;
+	bool		xacthashlocked = false;
 
 	Assert(MySerializableXact != InvalidSerializableXact);
 
@@ -4104,12 +4111,16 @@ CheckTargetForConflictsIn(PREDICATELOCKTARGETTAG *targettag)
 	/*
 	 * Each lock for an overlapping transaction represents a conflict: a
 	 * rw-dependency in to this transaction.
+	 *
+	 * SerializableXactHashLock is only needed to examine other transactions,
+	 * so don't take it until we meet a lock that isn't ours.  Often the only
+	 * SIREAD lock on the target is our own, from reading the tuple we're
+	 * now updating, and then we never touch that global lock at all.
 	 */
 	predlock = (PREDICATELOCK *)
 		SHMQueueNext(&(target->predicateLocks),
 					 &(target->predicateLocks),
 					 offsetof(PREDICATELOCK, targetLink));
-	LWLockAcquire(SerializableXactHashLock, LW_SHARED);
 	while (predlock)
 	{
 		SHM_QUEUE  *predlocktargetlink;
@@ -4141,8 +4152,17 @@ CheckTargetForConflictsIn(PREDICATELOCKTARGETTAG *targettag)
 				mypredlock = predlock;
 				mypredlocktag = predlock->tag;
 			}
+			predlock = nextpredlock;
+			continue;
+		}
+
+		if (!xacthashlocked)
+		{
+			LWLockAcquire(SerializableXactHashLock, LW_SHARED);
+			xacthashlocked = true;
 		}
-		else if (!SxactIsDoomed(sxact)
+
+		if (!SxactIsDoomed(sxact)
 				 && (!SxactIsCommitted(sxact)
 					 || TransactionIdPrecedes(GetTransactionSnapshot()->xmin,
 											  sxact->finishedBefore))
@@ -4170,7 +4190,8 @@ CheckTargetForConflictsIn(PREDICATELOCKTARGETTAG *targettag)
 
 		predlock = nextpredlock;
 	}
-	LWLockRelease(SerializableXactHashLock);
+	if (xacthashlocked)
+		LWLockRelease(SerializableXactHashLock);
 	LWLockRelease(partitionLock);
 
 	/*
@@ -39,6 +39,7 @@
 #include "access/twophase.h"
 #include "access/xact.h"
 #include "miscadmin.h"
+#include "pgstat.h"
 #include "postmaster/autovacuum.h"
 #include "replication/slot.h"
 #include "replication/syncrep.h"
@@ -89,8 +90,25 @@ static void RemoveProcFromArray(int code, Datum arg);
 static void ProcKill(int code, Datum arg);
 static void AuxiliaryProcKill(int code, Datum arg);
 static void CheckDeadLock(void);
+static Size FastPathLockShmemSize(void);
 
 
+/*
+ * Report shared-memory space needed by the fast-path lock arrays of all
+ * PGPROCs, see InitProcGlobal.
+ */
+static Size
+FastPathLockShmemSize(void)
+{
+	Size		size;
+	uint32		TotalProcs = MaxBackends + NUM_AUXILIARY_PROCS + max_prepared_xacts;
+
+	size = add_size(mul_size(FastPathLockGroupsPerBackend, sizeof(uint64)),
+				mul_size(FastPathLockSlotsPerBackend(), sizeof(Oid)));
+
+	return mul_size(TotalProcs, MAXALIGN(size));
+}
+
 /*
  * Report shared-memory space needed by InitProcGlobal.
  */
@@ -114,6 +132,9 @@ ProcGlobalShmemSize(void)
 	size = add_size(size, mul_size(NUM_AUXILIARY_PROCS, sizeof(PGXACT)));
 	size = add_size(size, mul_size(max_prepared_xacts, sizeof(PGXACT)));
 
+	/* fast-path lock arrays */
+	size = add_size(size, FastPathLockShmemSize());
+
 	return size;
 }
 
@@ -163,6 +184,9 @@ InitProcGlobal(void)
 				j;
 	bool		found;
 	uint32		TotalProcs = MaxBackends + NUM_AUXILIARY_PROCS + max_prepared_xacts;
+	char	   *fpPtr;
+	Size		fpLockBitsSize,
+				fpRelIdSize;
 
 	/* Create the ProcGlobal shared structure */
 	ProcGlobal = (PROC_HDR *)
@@ -181,6 +205,8 @@ InitProcGlobal(void)
 	ProcGlobal->startupBufferPinWaitBufId = -1;
 	ProcGlobal->walwriterLatch = NULL;
 	ProcGlobal->checkpointerLatch = NULL;
+	pg_atomic_init_u32(&ProcGlobal->procArrayGroupFirst, INVALID_PGPROCNO);
+	pg_atomic_init_u32(&ProcGlobal->clogGroupFirst, INVALID_PGPROCNO);
 
 	/*
 	 * Create and initialize all the PGPROC structures we'll need.  There are
@@ -212,6 +238,21 @@ InitProcGlobal(void)
 	MemSet(pgxacts, 0, TotalProcs * sizeof(PGXACT));
 	ProcGlobal->allPgXact = pgxacts;
 
+	/*
+	 * Allocate the fast-path lock arrays for all PGPROCs in one chunk.  Their
+	 * size depends on max_locks_per_transaction, so they can't be part of
+	 * PGPROC itself.
+	 */
+	fpLockBitsSize = MAXALIGN(FastPathLockGroupsPerBackend * sizeof(uint64));
+	fpRelIdSize = MAXALIGN(FastPathLockSlotsPerBackend() * sizeof(Oid));
+
+	fpPtr = ShmemAlloc(FastPathLockShmemSize());
+	if (!fpPtr)
+		ereport(FATAL,
+				(errcode(ERRCODE_OUT_OF_MEMORY),
+				 errmsg("out of shared memory")));
+	MemSet(fpPtr, 0, FastPathLockShmemSize());
+
 	for (i = 0; i < TotalProcs; i++)
 	{
 		/* Common initialization for all PGPROCs, regardless of type. */
@@ -229,6 +270,12 @@ InitProcGlobal(void)
 		}
 		procs[i].pgprocno = i;
 
+		/* Point the PGPROC at its fast-path lock arrays. */
+		procs[i].fpLockBits = (uint64 *) fpPtr;
+		fpPtr += fpLockBitsSize;
+		procs[i].fpRelId = (Oid *) fpPtr;
+		fpPtr += fpRelIdSize;
+
 		/*
 		 * Newly created PGPROCs for normal backends, autovacuum and bgworkers
 		 * must be queued up on the appropriate free list.  Because there can
@@ -259,6 +306,14 @@ InitProcGlobal(void)
 		/* Initialize myProcLocks[] shared memory queues. */
 		for (j = 0; j < NUM_LOCK_PARTITIONS; j++)
 			SHMQueueInit(&(procs[i].myProcLocks[j]));
+
+		/* Initialize the group XID clearing state. */
+		procs[i].procArrayGroupMember = false;
+		pg_atomic_init_u32(&(procs[i].procArrayGroupNext), INVALID_PGPROCNO);
+
+		/* Initialize the group transaction status update state. */
+		procs[i].clogGroupMember = false;
+		pg_atomic_init_u32(&(procs[i].clogGroupNext), INVALID_PGPROCNO);
 	}
 
 	/*
@@ -365,6 +420,7 @@ InitProcess(void)
 	/* NB -- autovac launcher intentionally does not set IS_AUTOVACUUM */
 	if (IsAutoVacuumWorkerProcess())
 		MyPgXact->vacuumFlags |= PROC_IS_AUTOVACUUM;
+	MyProc->wait_event_info = 0;
 	MyProc->lwWaiting = false;
 	MyProc->lwWaitMode = 0;
 	MyProc->waitLock = NULL;
@@ -380,6 +436,19 @@ InitProcess(void)
 #endif
 	MyProc->recoveryConflictPending = false;
 
+	/* Initialize fields for group XID clearing. */
+	MyProc->procArrayGroupMember = false;
+	MyProc->procArrayGroupMemberXid = InvalidTransactionId;
+	Assert(pg_atomic_read_u32(&MyProc->procArrayGroupNext) == INVALID_PGPROCNO);
+
+	/* Initialize fields for group transaction status update. */
+	MyProc->clogGroupMember = false;
+	MyProc->clogGroupMemberXid = InvalidTransactionId;
+	MyProc->clogGroupMemberXidStatus = TRANSACTION_STATUS_IN_PROGRESS;
+	MyProc->clogGroupMemberPage = -1;
+	MyProc->clogGroupMemberLsn = InvalidXLogRecPtr;
+	Assert(pg_atomic_read_u32(&MyProc->clogGroupNext) == INVALID_PGPROCNO);
+
 	/* Initialize fields for sync rep */
 	MyProc->waitLSN = 0;
 	MyProc->syncRepState = SYNC_REP_NOT_WAITING;
@@ -522,6 +591,7 @@ InitAuxiliaryProcess(void)
 	MyProc->roleId = InvalidOid;
 	MyPgXact->delayChkpt = false;
 	MyPgXact->vacuumFlags = 0;
+	MyProc->wait_event_info = 0;
 	MyProc->lwWaiting = false;
 	MyProc->lwWaitMode = 0;
 	MyProc->waitLock = NULL;
@@ -555,6 +625,9 @@ InitAuxiliaryProcess(void)
 	 * Arrange to clean up at process exit.
 	 */
 	on_shmem_exit(AuxiliaryProcKill, Int32GetDatum(proctype));
+
+	/* Now that we have a PGPROC, initialize local state needed for LWLocks */
+	InitLWLockAccess();
 }
 
 /*
@@ -1118,7 +1191,10 @@ ProcSleep(LOCALLOCK *locallock, LockMethod lockMethodTable)
 	 */
 	do
 	{
+		pgstat_report_wait_start(PG_WAIT_LOCK |
+								 locallock->tag.lock.locktag_type);
 		WaitLatch(MyLatch, WL_LATCH_SET, 0);
+		pgstat_report_wait_end();
 		ResetLatch(MyLatch);
 		/* check for deadlocks first, as that's probably log-worthy */
 		if (got_deadlock_timeout)
@@ -1506,8 +1582,35 @@ ProcLockWakeup(LockMethod lockMethodTable, LOCK *lock)
 static void
 CheckDeadLock(void)
 {
+	LWLock	   *partitionLock;
+	bool		needed;
 	int			i;
 
+	/*
+	 * First see whether a deadlock is possible at all, holding only the
+	 * partition lock of the lock we're waiting for.  With many backends
+	 * queued up behind a long-running lock holder, this saves each of them
+	 * from locking the whole lock table in turn just to find nothing.
+	 */
+	Assert(lockAwaited != NULL);
+	partitionLock = LockHashPartitionLock(lockAwaited->hashcode);
+	LWLockAcquire(partitionLock, LW_EXCLUSIVE);
+	if (MyProc->links.prev == NULL ||
+		MyProc->links.next == NULL)
+	{
+		/* Awoken in the interim, as below */
+		LWLockRelease(partitionLock);
+		return;
+	}
+	needed = DeadLockCheckNeeded(MyProc);
+	LWLockRelease(partitionLock);
+
+	if (!needed)
+	{
+		deadlock_state = DS_NO_DEADLOCK;
+		return;
+	}
+
 	/*
 	 * Acquire exclusive lock on the entire shared lock data structures. Must
 	 * grab LWLocks in partition-number order to avoid LWLock deadlock.
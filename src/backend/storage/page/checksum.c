@@ -13,11 +13,117 @@
  */
 #include "postgres.h"
 
+#ifdef USE_SIMD_CHECKSUM_WITH_RUNTIME_CHECK
+#ifdef HAVE__GET_CPUID
+#include <cpuid.h>
+#endif
+#ifdef HAVE__CPUID
+#include <intrin.h>
+#endif
+#endif
+
 #include "storage/checksum.h"
 
 /*
  * The actual code is in storage/checksum_impl.h.  This is done so that
  * external programs can incorporate the checksum code by #include'ing
  * that file from the exported Postgres headers.  (Compare our CRC code.)
+ *
+ * If the same code is also compiled for SSE 4.1 and AVX2, in
+ * checksum_sse41.c and checksum_avx2.c, the version here is only the
+ * fallback for processors that support neither, and pg_checksum_page calls
+ * the best version the processor supports through a function pointer.
  */
+#ifdef USE_SIMD_CHECKSUM_WITH_RUNTIME_CHECK
+static uint16 pg_checksum_page_generic(char *page, BlockNumber blkno);
+
+#define pg_checksum_page pg_checksum_page_generic
+#endif
+
 #include "storage/checksum_impl.h"
+
+#ifdef USE_SIMD_CHECKSUM_WITH_RUNTIME_CHECK
+#undef pg_checksum_page
+
+static uint16 pg_checksum_page_choose(char *page, BlockNumber blkno);
+
+static uint16 (*pg_checksum_page_impl) (char *page, BlockNumber blkno) =
+pg_checksum_page_choose;
+
+/*
+ * Read the extended control register XCR0, which tells which register
+ * states the operating system saves on context switches.
+ */
+static uint64
+pg_xgetbv0(void)
+{
+#if defined(HAVE__GET_CPUID)
+	uint32		eax,
+				edx;
+
+	__asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((uint64) edx << 32) | eax;
+#else
+	return _xgetbv(0);
+#endif
+}
+
+/*
+ * This gets called on the first call. It replaces the function pointer
+ * so that subsequent calls are routed directly to the chosen implementation.
+ */
+static uint16
+pg_checksum_page_choose(char *page, BlockNumber blkno)
+{
+	unsigned int exx[4] = {0, 0, 0, 0};
+	unsigned int maxleaf;
+	bool		have_avx2 = false;
+
+#if defined(HAVE__GET_CPUID)
+	maxleaf = __get_cpuid_max(0, NULL);
+	__get_cpuid(1, &exx[0], &exx[1], &exx[2], &exx[3]);
+#else
+	__cpuid(exx, 0);
+	maxleaf = exx[0];
+	__cpuid(exx, 1);
+#endif
+
+	/*
+	 * AVX2 needs the operating system to save the YMM registers, which it
+	 * tells in XCR0 if OSXSAVE is set.
+	 */
+	if ((exx[2] & (1 << 27)) != 0 &&	/* OSXSAVE */
+		(exx[2] & (1 << 28)) != 0 &&	/* AVX */
+		(pg_xgetbv0() & 0x06) == 0x06 &&	/* XMM and YMM state */
+		maxleaf >= 7)
+	{
+		unsigned int exx7[4] = {0, 0, 0, 0};
+
+#if defined(HAVE__GET_CPUID)
+		__cpuid_count(7, 0, exx7[0], exx7[1], exx7[2], exx7[3]);
+#else
+		__cpuidex(exx7, 7, 0);
+#endif
+		have_avx2 = (exx7[1] & (1 << 5)) != 0;
+	}
+
+	if (have_avx2)
+		pg_checksum_page_impl = pg_checksum_page_avx2;
+	else if ((exx[2] & (1 << 19)) != 0)		/* SSE 4.1 */
+		pg_checksum_page_impl = pg_checksum_page_sse41;
+	else
+		pg_checksum_page_impl = pg_checksum_page_generic;
+
+	return pg_checksum_page_impl(page, blkno);
+}
+
+/*
+ * Compute the checksum for a Postgres page, see checksum_impl.h.
+ */
+uint16
+pg_checksum_page(char *page, BlockNumber blkno)
+{
+	return pg_checksum_page_impl(page, blkno);
+}
+
+#endif   /* USE_SIMD_CHECKSUM_WITH_RUNTIME_CHECK */
@@ -0,0 +1,29 @@
+/*-------------------------------------------------------------------------
+ *
+ * checksum_avx2.c
+ *	  Checksum implementation for data pages, compiled for AVX2.
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * IDENTIFICATION
+ *	  src/backend/storage/page/checksum_avx2.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "storage/checksum.h"
+
+#ifdef USE_SIMD_CHECKSUM_WITH_RUNTIME_CHECK
+
+/*
+ * This is the code of checksum.c again, compiled with CFLAGS_AVX2 (and
+ * CFLAGS_VECTOR), so that the compiler vectorizes the checksum loop with
+ * 256-bit registers, eight columns at a time.  checksum.c only calls it if
+ * the processor and operating system support AVX2.
+ */
+#define pg_checksum_page pg_checksum_page_avx2
+#include "storage/checksum_impl.h"
+
+#endif   /* USE_SIMD_CHECKSUM_WITH_RUNTIME_CHECK */
@@ -0,0 +1,29 @@
+/*-------------------------------------------------------------------------
+ *
+ * checksum_sse41.c
+ *	  Checksum implementation for data pages, compiled for SSE 4.1.
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * IDENTIFICATION
+ *	  src/backend/storage/page/checksum_sse41.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "storage/checksum.h"
+
+#ifdef USE_SIMD_CHECKSUM_WITH_RUNTIME_CHECK
+
+/*
+ * This is the code of checksum.c again, compiled with CFLAGS_SSE41 (and
+ * CFLAGS_VECTOR), so that the compiler can vectorize the checksum loop with
+ * the 32-bit multiplication that SSE 4.1 added.  checksum.c only calls it if
+ * the processor supports SSE 4.1.
+ */
+#define pg_checksum_page pg_checksum_page_sse41
+#include "storage/checksum_impl.h"
+
+#endif   /* USE_SIMD_CHECKSUM_WITH_RUNTIME_CHECK */
@@ -28,6 +28,7 @@
 #include "miscadmin.h"
 #include "access/xlog.h"
 #include "catalog/catalog.h"
+#include "pgstat.h"
 #include "portability/instr_time.h"
 #include "postmaster/bgwriter.h"
 #include "storage/fd.h"
@@ -117,6 +118,24 @@ typedef struct _MdfdVec
 
 static MemoryContext MdCxt;		/* context for all MdfdVec objects */
 
+/* GUC variable */
+bool		data_direct_io = false;
+
+/* flags for opening relation segment files */
+#define MD_OPEN_FLAGS \
+	(O_RDWR | PG_BINARY | (data_direct_io ? PG_O_DIRECT : 0))
+
+/*
+ * With data_direct_io, the memory of every transfer to or from a data file
+ * must be aligned to PG_IO_ALIGN_SIZE.  Shared and local buffers always are,
+ * but some callers (index builds, for instance) hand us pages in palloc'd
+ * memory; those are copied through a bounce buffer.
+ */
+#define MdNeedsBounce(buf) \
+	(data_direct_io && (uintptr_t) (buf) % PG_IO_ALIGN_SIZE != 0)
+
+static char *md_bounce_buffer = NULL;	/* MAX_IO_COMBINE_BLOCKS blocks */
+
 
 /*
  * In some contexts (currently, standalone backends and the checkpointer)
@@ -162,6 +181,27 @@ static MemoryContext pendingOpsCxt;		/* context for the above  */
 static CycleCtr mdsync_cycle_ctr = 0;
 static CycleCtr mdckpt_cycle_ctr = 0;
 
+/*
+ * Regular backends remember the segments they recently forwarded an fsync
+ * request for, and the fsync request cycle in which they did so.  Another
+ * write to the same segment in the same cycle is covered by the request
+ * already sent, so there's no need to take CheckpointerCommLock and queue a
+ * duplicate.  During a bulk load that saves one request per block written.
+ * This is a small direct-mapped cache; collisions just evict.
+ */
+#define FORWARDED_FSYNC_CACHE_SIZE	64
+
+typedef struct
+{
+	RelFileNode rnode;
+	ForkNumber	forknum;
+	BlockNumber segno;
+	uint32		cycle;			/* GetFsyncRequestCycle() when forwarded */
+	bool		valid;
+} ForwardedFsyncEntry;
+
+static ForwardedFsyncEntry forwardedFsyncCache[FORWARDED_FSYNC_CACHE_SIZE];
+
 
 typedef enum					/* behavior for mdopen & _mdfd_getseg */
 {
@@ -183,6 +223,7 @@ static char *_mdfd_segpath(SMgrRelation reln, ForkNumber forknum,
 			  BlockNumber segno);
 static MdfdVec *_mdfd_openseg(SMgrRelation reln, ForkNumber forkno,
 			  BlockNumber segno, int oflags);
+static char *md_get_bounce_buffer(void);
 static MdfdVec *_mdfd_getseg(SMgrRelation reln, ForkNumber forkno,
 			 BlockNumber blkno, bool skipFsync, ExtensionBehavior behavior);
 static BlockNumber _mdnblocks(SMgrRelation reln, ForkNumber forknum,
@@ -297,7 +338,7 @@ mdcreate(SMgrRelation reln, ForkNumber forkNum, bool isRedo)
 
 	path = relpath(reln->smgr_rnode, forkNum);
 
-	fd = PathNameOpenFile(path, O_RDWR | O_CREAT | O_EXCL | PG_BINARY, 0600);
+	fd = PathNameOpenFile(path, MD_OPEN_FLAGS | O_CREAT | O_EXCL, 0600);
 
 	if (fd < 0)
 	{
@@ -310,7 +351,7 @@ mdcreate(SMgrRelation reln, ForkNumber forkNum, bool isRedo)
 		 * already, even if isRedo is not set.  (See also mdopen)
 		 */
 		if (isRedo || IsBootstrapProcessingMode())
-			fd = PathNameOpenFile(path, O_RDWR | PG_BINARY, 0600);
+			fd = PathNameOpenFile(path, MD_OPEN_FLAGS, 0600);
 		if (fd < 0)
 		{
 			/* be sure to report the error reported by create, not open */
@@ -531,7 +572,13 @@ mdextend(SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum,
 				 errmsg("could not seek to block %u in file \"%s\": %m",
 						blocknum, FilePathName(v->mdfd_vfd))));
 
-	if ((nbytes = FileWrite(v->mdfd_vfd, buffer, BLCKSZ)) != BLCKSZ)
+	if (MdNeedsBounce(buffer))
+		buffer = memcpy(md_get_bounce_buffer(), buffer, BLCKSZ);
+
+	pgstat_report_wait_start(WAIT_EVENT_DATA_FILE_EXTEND);
+	nbytes = FileWrite(v->mdfd_vfd, buffer, BLCKSZ);
+	pgstat_report_wait_end();
+	if (nbytes != BLCKSZ)
 	{
 		if (nbytes < 0)
 			ereport(ERROR,
@@ -577,7 +624,7 @@ mdopen(SMgrRelation reln, ForkNumber forknum, ExtensionBehavior behavior)
 
 	path = relpath(reln->smgr_rnode, forknum);
 
-	fd = PathNameOpenFile(path, O_RDWR | PG_BINARY, 0600);
+	fd = PathNameOpenFile(path, MD_OPEN_FLAGS, 0600);
 
 	if (fd < 0)
 	{
@@ -588,7 +635,7 @@ mdopen(SMgrRelation reln, ForkNumber forknum, ExtensionBehavior behavior)
 		 * substitute for mdcreate() in bootstrap mode only. (See mdcreate)
 		 */
 		if (IsBootstrapProcessingMode())
-			fd = PathNameOpenFile(path, O_RDWR | O_CREAT | O_EXCL | PG_BINARY, 0600);
+			fd = PathNameOpenFile(path, MD_OPEN_FLAGS | O_CREAT | O_EXCL, 0600);
 		if (fd < 0)
 		{
 			if (behavior == EXTENSION_RETURN_NULL &&
@@ -652,6 +699,10 @@ mdprefetch(SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum)
 	off_t		seekpos;
 	MdfdVec    *v;
 
+	/* reads bypass the kernel's cache, so there's no point filling it */
+	if (data_direct_io)
+		return;
+
 	v = _mdfd_getseg(reln, forknum, blocknum, false, EXTENSION_FAIL);
 
 	seekpos = (off_t) BLCKSZ *(blocknum % ((BlockNumber) RELSEG_SIZE));
@@ -692,7 +743,18 @@ mdread(SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum,
 				 errmsg("could not seek to block %u in file \"%s\": %m",
 						blocknum, FilePathName(v->mdfd_vfd))));
 
-	nbytes = FileRead(v->mdfd_vfd, buffer, BLCKSZ);
+	pgstat_report_wait_start(WAIT_EVENT_DATA_FILE_READ);
+	if (MdNeedsBounce(buffer))
+	{
+		char	   *bounce = md_get_bounce_buffer();
+
+		nbytes = FileRead(v->mdfd_vfd, bounce, BLCKSZ);
+		if (nbytes > 0)
+			memcpy(buffer, bounce, nbytes);
+	}
+	else
+		nbytes = FileRead(v->mdfd_vfd, buffer, BLCKSZ);
+	pgstat_report_wait_end();
 
 	TRACE_POSTGRESQL_SMGR_MD_READ_DONE(forknum, blocknum,
 									   reln->smgr_rnode.node.spcNode,
@@ -767,7 +829,12 @@ mdwrite(SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum,
 				 errmsg("could not seek to block %u in file \"%s\": %m",
 						blocknum, FilePathName(v->mdfd_vfd))));
 
+	if (MdNeedsBounce(buffer))
+		buffer = memcpy(md_get_bounce_buffer(), buffer, BLCKSZ);
+
+	pgstat_report_wait_start(WAIT_EVENT_DATA_FILE_WRITE);
 	nbytes = FileWrite(v->mdfd_vfd, buffer, BLCKSZ);
+	pgstat_report_wait_end();
 
 	TRACE_POSTGRESQL_SMGR_MD_WRITE_DONE(forknum, blocknum,
 										reln->smgr_rnode.node.spcNode,
@@ -798,6 +865,249 @@ mdwrite(SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum,
 		register_dirty_segment(reln, forknum, v);
 }
 
+/*
+ *	mdreadv() -- Read a run of consecutive blocks.
+ *
+ *		The run is split at segment boundaries, and each part is read with
+ *		a single FileReadV.  Short reads are treated the same way as in
+ *		mdread: blocks at or beyond EOF are zeroed if zero_damaged_pages is
+ *		on or we are InRecovery, and otherwise are an error.
+ */
+void
+mdreadv(SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum,
+		char **buffers, BlockNumber nblocks)
+{
+	struct iovec iov[MAX_IO_COMBINE_BLOCKS];
+
+	while (nblocks > 0)
+	{
+		off_t		seekpos;
+		int			nbytes;
+		int			nchunk;
+		int			i;
+		bool		bounce;
+		MdfdVec    *v;
+
+		v = _mdfd_getseg(reln, forknum, blocknum, false, EXTENSION_FAIL);
+
+		seekpos = (off_t) BLCKSZ *(blocknum % ((BlockNumber) RELSEG_SIZE));
+
+		Assert(seekpos < (off_t) BLCKSZ * RELSEG_SIZE);
+
+		/* don't cross into the next segment, or overflow iov[] */
+		nchunk = Min(nblocks, RELSEG_SIZE - blocknum % ((BlockNumber) RELSEG_SIZE));
+		nchunk = Min(nchunk, MAX_IO_COMBINE_BLOCKS);
+
+		bounce = false;
+		for (i = 0; i < nchunk; i++)
+		{
+			iov[i].iov_base = buffers[i];
+			iov[i].iov_len = BLCKSZ;
+			if (MdNeedsBounce(buffers[i]))
+				bounce = true;
+		}
+		if (bounce)
+		{
+			for (i = 0; i < nchunk; i++)
+				iov[i].iov_base = md_get_bounce_buffer() + BLCKSZ * i;
+		}
+
+		if (FileSeek(v->mdfd_vfd, seekpos, SEEK_SET) != seekpos)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not seek to block %u in file \"%s\": %m",
+							blocknum, FilePathName(v->mdfd_vfd))));
+
+		nbytes = FileReadV(v->mdfd_vfd, iov, nchunk);
+
+		if (bounce && nbytes > 0)
+		{
+			for (i = 0; i < nchunk; i++)
+				memcpy(buffers[i], iov[i].iov_base, BLCKSZ);
+		}
+
+		if (nbytes != BLCKSZ * nchunk)
+		{
+			BlockNumber badblock;
+
+			if (nbytes < 0)
+				ereport(ERROR,
+						(errcode_for_file_access(),
+						 errmsg("could not read blocks %u..%u in file \"%s\": %m",
+								blocknum, blocknum + nchunk - 1,
+								FilePathName(v->mdfd_vfd))));
+
+			/* see mdread for why this is okay sometimes */
+			badblock = blocknum + nbytes / BLCKSZ;
+			if (!(zero_damaged_pages || InRecovery))
+				ereport(ERROR,
+						(errcode(ERRCODE_DATA_CORRUPTED),
+						 errmsg("could not read block %u in file \"%s\": read only %d of %d bytes",
+								badblock, FilePathName(v->mdfd_vfd),
+								nbytes % BLCKSZ, BLCKSZ)));
+			for (i = nbytes / BLCKSZ; i < nchunk; i++)
+				MemSet(buffers[i], 0, BLCKSZ);
+		}
+
+		buffers += nchunk;
+		blocknum += nchunk;
+		nblocks -= nchunk;
+	}
+}
+
+/*
+ *	mdwritev() -- Write a run of consecutive blocks.
+ *
+ *		As with mdwrite, the blocks must already exist.  The run is split at
+ *		segment boundaries, and each part is written with a single
+ *		FileWriteV.
+ */
+void
+mdwritev(SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum,
+		 char **buffers, BlockNumber nblocks, bool skipFsync)
+{
+	struct iovec iov[MAX_IO_COMBINE_BLOCKS];
+
+	/* This assert is too expensive to have on normally ... */
+#ifdef CHECK_WRITE_VS_EXTEND
+	Assert(blocknum + nblocks <= mdnblocks(reln, forknum));
+#endif
+
+	while (nblocks > 0)
+	{
+		off_t		seekpos;
+		int			nbytes;
+		int			nchunk;
+		int			i;
+		MdfdVec    *v;
+
+		v = _mdfd_getseg(reln, forknum, blocknum, skipFsync, EXTENSION_FAIL);
+
+		seekpos = (off_t) BLCKSZ *(blocknum % ((BlockNumber) RELSEG_SIZE));
+
+		Assert(seekpos < (off_t) BLCKSZ * RELSEG_SIZE);
+
+		nchunk = Min(nblocks, RELSEG_SIZE - blocknum % ((BlockNumber) RELSEG_SIZE));
+		nchunk = Min(nchunk, MAX_IO_COMBINE_BLOCKS);
+
+		for (i = 0; i < nchunk; i++)
+		{
+			iov[i].iov_base = buffers[i];
+			iov[i].iov_len = BLCKSZ;
+			if (MdNeedsBounce(buffers[i]))
+			{
+				iov[i].iov_base = md_get_bounce_buffer() + BLCKSZ * i;
+				memcpy(iov[i].iov_base, buffers[i], BLCKSZ);
+			}
+		}
+
+		if (FileSeek(v->mdfd_vfd, seekpos, SEEK_SET) != seekpos)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not seek to block %u in file \"%s\": %m",
+							blocknum, FilePathName(v->mdfd_vfd))));
+
+		nbytes = FileWriteV(v->mdfd_vfd, iov, nchunk);
+
+		if (nbytes != BLCKSZ * nchunk)
+		{
+			if (nbytes < 0)
+				ereport(ERROR,
+						(errcode_for_file_access(),
+						 errmsg("could not write blocks %u..%u in file \"%s\": %m",
+								blocknum, blocknum + nchunk - 1,
+								FilePathName(v->mdfd_vfd))));
+			/* short write: complain appropriately */
+			ereport(ERROR,
+					(errcode(ERRCODE_DISK_FULL),
+					 errmsg("could not write blocks %u..%u in file \"%s\": wrote only %d of %d bytes",
+							blocknum, blocknum + nchunk - 1,
+							FilePathName(v->mdfd_vfd),
+							nbytes, BLCKSZ * nchunk),
+					 errhint("Check free disk space.")));
+		}
+
+		if (!skipFsync && !SmgrIsTemp(reln))
+			register_dirty_segment(reln, forknum, v);
+
+		buffers += nchunk;
+		blocknum += nchunk;
+		nblocks -= nchunk;
+	}
+}
+
+/*
+ *	mdwriteback() -- Tell the kernel to write pages back to storage.
+ *
+ *		The range may span segment boundaries.  Blocks beyond the current
+ *		end of the relation, which can happen if it was truncated after the
+ *		writes were issued, are silently ignored.
+ */
+void
+mdwriteback(SMgrRelation reln, ForkNumber forknum,
+			BlockNumber blocknum, BlockNumber nblocks)
+{
+	while (nblocks > 0)
+	{
+		BlockNumber nflush = nblocks;
+		off_t		seekpos;
+		MdfdVec    *v;
+		BlockNumber segoff;
+
+		v = _mdfd_getseg(reln, forknum, blocknum, false,
+						 EXTENSION_RETURN_NULL);
+		if (v == NULL)
+			return;
+
+		/* don't run past the end of this segment */
+		segoff = blocknum % ((BlockNumber) RELSEG_SIZE);
+		if (segoff + nflush > (BlockNumber) RELSEG_SIZE)
+			nflush = (BlockNumber) RELSEG_SIZE - segoff;
+
+		seekpos = (off_t) BLCKSZ *segoff;
+
+		FileWriteback(v->mdfd_vfd, seekpos, (off_t) BLCKSZ * nflush);
+
+		nblocks -= nflush;
+		blocknum += nflush;
+	}
+}
+
+/*
+ *	mdpreallocate() -- Reserve disk space for blocks about to be added to
+ *					   the specified relation.
+ *
+ * Only segments that exist already are dealt with; we don't create new
+ * ones just for this.
+ */
+void
+mdpreallocate(SMgrRelation reln, ForkNumber forknum,
+			  BlockNumber blocknum, BlockNumber nblocks)
+{
+	while (nblocks > 0)
+	{
+		BlockNumber nalloc = nblocks;
+		MdfdVec    *v;
+		BlockNumber segoff;
+
+		v = _mdfd_getseg(reln, forknum, blocknum, false,
+						 EXTENSION_RETURN_NULL);
+		if (v == NULL)
+			return;
+
+		/* don't run past the end of this segment */
+		segoff = blocknum % ((BlockNumber) RELSEG_SIZE);
+		if (segoff + nalloc > (BlockNumber) RELSEG_SIZE)
+			nalloc = (BlockNumber) RELSEG_SIZE - segoff;
+
+		FilePreallocate(v->mdfd_vfd, (off_t) BLCKSZ * segoff,
+						(off_t) BLCKSZ * nalloc);
+
+		nblocks -= nalloc;
+		blocknum += nalloc;
+	}
+}
+
 /*
  *	mdnblocks() -- Get the number of blocks stored in a relation.
  *
@@ -907,11 +1217,13 @@ mdtruncate(SMgrRelation reln, ForkNumber forknum, BlockNumber nblocks)
 			 * from the mdfd_chain). We truncate the file, but do not delete
 			 * it, for reasons explained in the header comments.
 			 */
+			pgstat_report_wait_start(WAIT_EVENT_DATA_FILE_TRUNCATE);
 			if (FileTruncate(v->mdfd_vfd, 0) < 0)
 				ereport(ERROR,
 						(errcode_for_file_access(),
 						 errmsg("could not truncate file \"%s\": %m",
 								FilePathName(v->mdfd_vfd))));
+			pgstat_report_wait_end();
 
 			if (!SmgrIsTemp(reln))
 				register_dirty_segment(reln, forknum, v);
@@ -932,12 +1244,14 @@ mdtruncate(SMgrRelation reln, ForkNumber forknum, BlockNumber nblocks)
 			 */
 			BlockNumber lastsegblocks = nblocks - priorblocks;
 
+			pgstat_report_wait_start(WAIT_EVENT_DATA_FILE_TRUNCATE);
 			if (FileTruncate(v->mdfd_vfd, (off_t) lastsegblocks * BLCKSZ) < 0)
 				ereport(ERROR,
 						(errcode_for_file_access(),
 					errmsg("could not truncate file \"%s\" to %u blocks: %m",
 						   FilePathName(v->mdfd_vfd),
 						   nblocks)));
+			pgstat_report_wait_end();
 			if (!SmgrIsTemp(reln))
 				register_dirty_segment(reln, forknum, v);
 			v = v->mdfd_chain;
@@ -976,11 +1290,13 @@ mdimmedsync(SMgrRelation reln, ForkNumber forknum)
 
 	while (v != NULL)
 	{
+		pgstat_report_wait_start(WAIT_EVENT_DATA_FILE_IMMEDIATE_SYNC);
 		if (FileSync(v->mdfd_vfd) < 0)
 			ereport(ERROR,
 					(errcode_for_file_access(),
 					 errmsg("could not fsync file \"%s\": %m",
 							FilePathName(v->mdfd_vfd))));
+		pgstat_report_wait_end();
 		v = v->mdfd_chain;
 	}
 }
@@ -1061,6 +1377,12 @@ mdsync(void)
 	/* Advance counter so that new hashtable entries are distinguishable */
 	mdsync_cycle_ctr++;
 
+	/*
+	 * Likewise, writes from now on aren't covered by the requests we're about
+	 * to process, so backends must send new ones.
+	 */
+	AdvanceFsyncRequestCycle();
+
 	/* Set flag to detect failure if we don't reach the end of the loop */
 	mdsync_in_progress = true;
 
@@ -1144,6 +1466,7 @@ mdsync(void)
 					MdfdVec    *seg;
 					char	   *path;
 					int			save_errno;
+					bool		synced;
 
 					/*
 					 * Find or create an smgr hash entry for this relation.
@@ -1168,8 +1491,12 @@ mdsync(void)
 
 					INSTR_TIME_SET_CURRENT(sync_start);
 
-					if (seg != NULL &&
-						FileSync(seg->mdfd_vfd) >= 0)
+					pgstat_report_wait_start(WAIT_EVENT_DATA_FILE_SYNC);
+					synced = (seg != NULL &&
+							  FileSync(seg->mdfd_vfd) >= 0);
+					pgstat_report_wait_end();
+
+					if (synced)
 					{
 						/* Success; update statistics about sync timing */
 						INSTR_TIME_SET_CURRENT(sync_end);
@@ -1374,17 +1701,47 @@ register_dirty_segment(SMgrRelation reln, ForkNumber forknum, MdfdVec *seg)
 	}
 	else
 	{
-		if (ForwardFsyncRequest(reln->smgr_rnode.node, forknum, seg->mdfd_segno))
-			return;				/* passed it off successfully */
+		RelFileNode rnode = reln->smgr_rnode.node;
+		ForwardedFsyncEntry *fwd;
+		uint32		cycle;
+
+		/*
+		 * Skip the request if we already sent one for this segment in the
+		 * current cycle.  The cycle must be read after our write and before
+		 * forwarding; see GetFsyncRequestCycle.
+		 */
+		cycle = GetFsyncRequestCycle();
+		fwd = &forwardedFsyncCache[(rnode.relNode + seg->mdfd_segno * 7 +
+									forknum) % FORWARDED_FSYNC_CACHE_SIZE];
+		if (fwd->valid && fwd->cycle == cycle &&
+			RelFileNodeEquals(fwd->rnode, rnode) &&
+			fwd->forknum == forknum && fwd->segno == seg->mdfd_segno)
+		{
+			CountSkippedFsyncRequest();
+			return;
+		}
+
+		if (ForwardFsyncRequest(rnode, forknum, seg->mdfd_segno))
+		{
+			/* passed it off successfully */
+			fwd->rnode = rnode;
+			fwd->forknum = forknum;
+			fwd->segno = seg->mdfd_segno;
+			fwd->cycle = cycle;
+			fwd->valid = true;
+			return;
+		}
 
 		ereport(DEBUG1,
 				(errmsg("could not forward fsync request because request queue is full")));
 
+		pgstat_report_wait_start(WAIT_EVENT_DATA_FILE_SYNC);
 		if (FileSync(seg->mdfd_vfd) < 0)
 			ereport(ERROR,
 					(errcode_for_file_access(),
 					 errmsg("could not fsync file \"%s\": %m",
 							FilePathName(seg->mdfd_vfd))));
+		pgstat_report_wait_end();
 	}
 }
 
@@ -1607,6 +1964,12 @@ ForgetRelationFsyncRequests(RelFileNode rnode, ForkNumber forknum)
 		while (!ForwardFsyncRequest(rnode, forknum, FORGET_RELATION_FSYNC))
 			pg_usleep(10000L);	/* 10 msec seems a good number */
 
+		/*
+		 * Requests forwarded before the cancel message don't count anymore,
+		 * so don't let any backend skip sending a new one.
+		 */
+		AdvanceFsyncRequestCycle();
+
 		/*
 		 * Note we don't wait for the checkpointer to actually absorb the
 		 * cancel message; see mdsync() for the implications.
@@ -1637,6 +2000,7 @@ ForgetDatabaseFsyncRequests(Oid dbid)
 		while (!ForwardFsyncRequest(rnode, InvalidForkNumber,
 									FORGET_DATABASE_FSYNC))
 			pg_usleep(10000L);	/* 10 msec seems a good number */
+		AdvanceFsyncRequestCycle();
 	}
 }
 
@@ -1688,7 +2052,7 @@ _mdfd_openseg(SMgrRelation reln, ForkNumber forknum, BlockNumber segno,
 	fullpath = _mdfd_segpath(reln, forknum, segno);
 
 	/* open the file */
-	fd = PathNameOpenFile(fullpath, O_RDWR | PG_BINARY | oflags, 0600);
+	fd = PathNameOpenFile(fullpath, MD_OPEN_FLAGS | oflags, 0600);
 
 	pfree(fullpath);
 
@@ -1708,6 +2072,22 @@ _mdfd_openseg(SMgrRelation reln, ForkNumber forknum, BlockNumber segno,
 	return v;
 }
 
+/*
+ * md_get_bounce_buffer() -- get the aligned buffer for data_direct_io.
+ *
+ * It holds MAX_IO_COMBINE_BLOCKS blocks, and is allocated on first use.
+ */
+static char *
+md_get_bounce_buffer(void)
+{
+	if (md_bounce_buffer == NULL)
+		md_bounce_buffer = (char *)
+			IOALIGN(MemoryContextAlloc(MdCxt,
+									   BLCKSZ * MAX_IO_COMBINE_BLOCKS +
+									   PG_IO_ALIGN_SIZE));
+	return md_bounce_buffer;
+}
+
 /*
  *	_mdfd_getseg() -- Find the segment of the relation holding the
  *		specified block.
@@ -18,6 +18,7 @@
 #include "tsearch/dicts/spell.h"
 #include "tsearch/ts_locale.h"
 #include "utils/memutils.h"
+#include "utils/sharedtsdict.h"
 
 
 /*
@@ -422,6 +423,17 @@ NIAddAffix(IspellDict *Conf, int flag, char flagflags, const char *mask, const c
 		else
 			sprintf(tmask, "^%s", mask);
 
+		/*
+		 * The regex library keeps compiled regexes in malloc'd memory, which
+		 * other backends can't see, so a dictionary with such an affix can't
+		 * be built in shared memory.
+		 */
+		if (SharedTSDictBuilding)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("affix \"%s\" cannot be kept in shared memory",
+							mask)));
+
 		masklen = strlen(tmask);
 		wmask = (pg_wchar *) tmpalloc((masklen + 1) * sizeof(pg_wchar));
 		wmasklen = pg_mb2wchar_with_len(tmask, wmask, masklen);
@@ -0,0 +1,300 @@
+/*-------------------------------------------------------------------------
+ *
+ * checksumfuncs.c
+ *	  Functions for verifying data page checksums in a running cluster.
+ *
+ * The blocks are read from disk into local memory, rather than through
+ * shared buffers.  That way, checking a large relation doesn't push the
+ * working set out of shared buffers, and the copy on disk is checked even
+ * if the block is cached.  Reading a block that is concurrently written out
+ * from shared buffers could see a torn page, though, so we hold the buffer
+ * mapping partition lock of the block while reading it: that keeps it from
+ * being loaded into shared buffers meanwhile, and if it's there already,
+ * keeps its buffer from being evicted.  In the latter case, we also hold the
+ * buffer's I/O lock, to keep it from being written out meanwhile.
+ *
+ * The reads are throttled with the cost-based vacuum delay settings.
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ * IDENTIFICATION
+ *	  src/backend/utils/adt/checksumfuncs.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "access/xlog.h"
+#include "catalog/pg_class.h"
+#include "commands/vacuum.h"
+#include "common/relpath.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "storage/buf_internals.h"
+#include "storage/bufmgr.h"
+#include "storage/checksum.h"
+#include "storage/smgr.h"
+#include "utils/builtins.h"
+#include "utils/rel.h"
+
+
+static void check_relation(FunctionCallInfo fcinfo, ForkNumber forknum);
+static void check_relation_fork(Tuplestorestate *tupstore, TupleDesc tupdesc,
+					Relation relation, ForkNumber forknum);
+static bool check_one_block(Relation relation, ForkNumber forknum,
+				BlockNumber blkno, char *buffer, bool *checkable,
+				uint16 *expected);
+
+
+/*
+ * pg_check_relation
+ *
+ * Verify the checksums of all blocks of the given relation, and return a row
+ * for each block that fails.
+ */
+Datum
+pg_check_relation(PG_FUNCTION_ARGS)
+{
+	check_relation(fcinfo, InvalidForkNumber);
+
+	return (Datum) 0;
+}
+
+/*
+ * pg_check_relation_fork
+ *
+ * As above, but only for the given fork of the relation.
+ */
+Datum
+pg_check_relation_fork(PG_FUNCTION_ARGS)
+{
+	text	   *forkname = PG_GETARG_TEXT_P(1);
+
+	check_relation(fcinfo, forkname_to_number(text_to_cstring(forkname)));
+
+	return (Datum) 0;
+}
+
+/*
+ * Common code for the above.  The relation is the first argument; if forknum
+ * is InvalidForkNumber, all its forks are checked.
+ */
+static void
+check_relation(FunctionCallInfo fcinfo, ForkNumber forknum)
+{
+	Oid			relid = PG_GETARG_OID(0);
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	Relation	relation;
+
+	if (!superuser())
+		ereport(ERROR,
+				(errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+				 (errmsg("must be superuser to verify data checksums"))));
+
+	if (!DataChecksumsEnabled())
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("data checksums are not enabled in this cluster")));
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	/* Build tuplestore to hold the result rows */
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	relation = relation_open(relid, AccessShareLock);
+
+	if (relation->rd_rel->relkind != RELKIND_RELATION &&
+		relation->rd_rel->relkind != RELKIND_INDEX &&
+		relation->rd_rel->relkind != RELKIND_MATVIEW &&
+		relation->rd_rel->relkind != RELKIND_SEQUENCE &&
+		relation->rd_rel->relkind != RELKIND_TOASTVALUE)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("\"%s\" is not a table, index, materialized view, sequence, or TOAST table",
+						RelationGetRelationName(relation))));
+
+	/* The blocks of temporary relations are in local buffers */
+	if (RelationUsesLocalBuffers(relation))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("cannot verify data checksums of temporary relations")));
+
+	/* Throttle the reads like VACUUM does */
+	VacuumCostActive = (VacuumCostDelay > 0);
+	VacuumCostBalance = 0;
+
+	PG_TRY();
+	{
+		if (forknum != InvalidForkNumber)
+			check_relation_fork(tupstore, tupdesc, relation, forknum);
+		else
+		{
+			for (forknum = 0; forknum <= MAX_FORKNUM; forknum++)
+				check_relation_fork(tupstore, tupdesc, relation, forknum);
+		}
+	}
+	PG_CATCH();
+	{
+		VacuumCostActive = false;
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	VacuumCostActive = false;
+
+	relation_close(relation, AccessShareLock);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+}
+
+/*
+ * Verify the blocks of one fork of a relation, adding a row to tupstore for
+ * each that fails.
+ */
+static void
+check_relation_fork(Tuplestorestate *tupstore, TupleDesc tupdesc,
+					Relation relation, ForkNumber forknum)
+{
+	BlockNumber nblocks;
+	BlockNumber blkno;
+	char	   *buffer;
+
+	RelationOpenSmgr(relation);
+	if (!smgrexists(relation->rd_smgr, forknum))
+		return;
+
+	/*
+	 * Blocks added after this are not checked.  The relation can't get
+	 * shorter meanwhile, since truncating it takes a stronger lock than
+	 * ours.
+	 */
+	nblocks = RelationGetNumberOfBlocksInFork(relation, forknum);
+
+	/* palloc'd, so aligned as the checksum calculation needs */
+	buffer = palloc(BLCKSZ);
+
+	for (blkno = 0; blkno < nblocks; blkno++)
+	{
+		bool		checkable;
+		uint16		expected;
+		Datum		values[5];
+		bool		nulls[5];
+
+		vacuum_delay_point();
+
+		if (check_one_block(relation, forknum, blkno, buffer, &checkable,
+							&expected))
+			continue;
+
+		memset(nulls, 0, sizeof(nulls));
+		values[0] = ObjectIdGetDatum(RelationGetRelid(relation));
+		values[1] = CStringGetTextDatum(forkNames[forknum]);
+		values[2] = Int64GetDatum((int64) blkno);
+		if (checkable)
+			values[3] = Int32GetDatum(expected);
+		else
+			nulls[3] = true;
+		values[4] = Int32GetDatum(((PageHeader) buffer)->pd_checksum);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	pfree(buffer);
+}
+
+/*
+ * Read one block into buffer and verify it.  Returns false if it fails,
+ * with *expected set to the checksum it should have, or *checkable set to
+ * false if it's a new page that isn't all zeros, so that no checksum
+ * applies.
+ *
+ * A block that is dirty in shared buffers is not verified, since its copy
+ * on disk will be overwritten anyway.
+ */
+static bool
+check_one_block(Relation relation, ForkNumber forknum, BlockNumber blkno,
+				char *buffer, bool *checkable, uint16 *expected)
+{
+	BufferTag	tag;
+	uint32		hashcode;
+	LWLock	   *partitionLock;
+	int			buf_id;
+	BufferDesc *bufdesc = NULL;
+	bool		dirty = false;
+	Page		page = (Page) buffer;
+
+	INIT_BUFFERTAG(tag, relation->rd_smgr->smgr_rnode.node, forknum, blkno);
+	hashcode = BufTableHashCode(&tag);
+	partitionLock = BufMappingPartitionLock(hashcode);
+
+	LWLockAcquire(partitionLock, LW_SHARED);
+	buf_id = BufTableLookup(&tag, hashcode);
+	if (buf_id >= 0)
+	{
+		/* wait for any write of the buffer to finish, and hold off others */
+		bufdesc = GetBufferDescriptor(buf_id);
+		LWLockAcquire(bufdesc->io_in_progress_lock, LW_SHARED);
+		dirty = (pg_atomic_read_u32(&bufdesc->state) & BM_DIRTY) != 0;
+	}
+
+	if (!dirty)
+		smgrread(relation->rd_smgr, forknum, blkno, buffer);
+
+	if (bufdesc)
+		LWLockRelease(bufdesc->io_in_progress_lock);
+	LWLockRelease(partitionLock);
+
+	VacuumCostBalance += VacuumCostPageMiss;
+
+	if (dirty)
+		return true;
+
+	*checkable = !PageIsNew(page);
+	if (!*checkable)
+	{
+		/* a new page must be all zeros, as PageIsVerified checks */
+		size_t	   *pagebytes = (size_t *) page;
+		int			i;
+
+		for (i = 0; i < (BLCKSZ / sizeof(size_t)); i++)
+		{
+			if (pagebytes[i] != 0)
+				return false;
+		}
+		return true;
+	}
+
+	*expected = pg_checksum_page(buffer, blkno);
+
+	return *expected == ((PageHeader) page)->pd_checksum;
+}
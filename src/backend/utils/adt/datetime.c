@@ -423,6 +423,21 @@ TrimTrailingZeros(char *str)
 static void
 AppendSeconds(char *cp, int sec, fsec_t fsec, int precision, bool fillzeros)
 {
+#ifdef HAVE_INT64_TIMESTAMP
+	/* this is equivalent to the sprintf() calls below, but much faster */
+	cp = pg_ltostr_zeropad(cp, abs(sec), fillzeros ? 2 : 1);
+	if (fsec != 0)
+	{
+		char	   *frac = cp;
+
+		*cp++ = '.';
+		cp = pg_ltostr_zeropad(cp, (int32) Abs(fsec), precision);
+		*cp = '\0';
+		TrimTrailingZeros(frac);
+	}
+	else
+		*cp = '\0';
+#else
 	if (fsec == 0)
 	{
 		if (fillzeros)
@@ -432,19 +447,13 @@ AppendSeconds(char *cp, int sec, fsec_t fsec, int precision, bool fillzeros)
 	}
 	else
 	{
-#ifdef HAVE_INT64_TIMESTAMP
-		if (fillzeros)
-			sprintf(cp, "%02d.%0*d", abs(sec), precision, (int) Abs(fsec));
-		else
-			sprintf(cp, "%d.%0*d", abs(sec), precision, (int) Abs(fsec));
-#else
 		if (fillzeros)
 			sprintf(cp, "%0*.*f", precision + 3, precision, fabs(sec + fsec));
 		else
 			sprintf(cp, "%.*f", precision, fabs(sec + fsec));
-#endif
 		TrimTrailingZeros(cp);
 	}
+#endif
 }
 
 /* Variant of above that's specialized to timestamp case */
@@ -3850,12 +3859,18 @@ EncodeTimezone(char *str, int tz, int style)
 	/* TZ is negated compared to sign we wish to display ... */
 	*str++ = (tz <= 0 ? '+' : '-');
 
+	str = pg_ltostr_zeropad(str, hour, 2);
+	if (sec != 0 || min != 0 || style == USE_XSD_DATES)
+	{
+		*str++ = ':';
+		str = pg_ltostr_zeropad(str, min, 2);
+	}
 	if (sec != 0)
-		sprintf(str, "%02d:%02d:%02d", hour, min, sec);
-	else if (min != 0 || style == USE_XSD_DATES)
-		sprintf(str, "%02d:%02d", hour, min);
-	else
-		sprintf(str, "%02d", hour);
+	{
+		*str++ = ':';
+		str = pg_ltostr_zeropad(str, sec, 2);
+	}
+	*str = '\0';
 }
 
 /* EncodeDateOnly()
@@ -3972,16 +3987,23 @@ EncodeDateTime(struct pg_tm * tm, fsec_t fsec, bool print_tz, int tz, const char
 		case USE_XSD_DATES:
 			/* Compatible with ISO-8601 date formats */
 
-			if (style == USE_ISO_DATES)
-				sprintf(str, "%04d-%02d-%02d %02d:%02d:",
-						(tm->tm_year > 0) ? tm->tm_year : -(tm->tm_year - 1),
-						tm->tm_mon, tm->tm_mday, tm->tm_hour, tm->tm_min);
-			else
-				sprintf(str, "%04d-%02d-%02dT%02d:%02d:",
-						(tm->tm_year > 0) ? tm->tm_year : -(tm->tm_year - 1),
-						tm->tm_mon, tm->tm_mday, tm->tm_hour, tm->tm_min);
-
-			AppendTimestampSeconds(str + strlen(str), tm, fsec);
+			/*
+			 * This is the default style, so build it up by hand rather than
+			 * with sprintf(), which is a good deal slower.
+			 */
+			str = pg_ltostr_zeropad(str,
+					(tm->tm_year > 0) ? tm->tm_year : -(tm->tm_year - 1), 4);
+			*str++ = '-';
+			str = pg_ltostr_zeropad(str, tm->tm_mon, 2);
+			*str++ = '-';
+			str = pg_ltostr_zeropad(str, tm->tm_mday, 2);
+			*str++ = (style == USE_ISO_DATES) ? ' ' : 'T';
+			str = pg_ltostr_zeropad(str, tm->tm_hour, 2);
+			*str++ = ':';
+			str = pg_ltostr_zeropad(str, tm->tm_min, 2);
+			*str++ = ':';
+
+			AppendTimestampSeconds(str, tm, fsec);
 
 			if (print_tz)
 				EncodeTimezone(str, tz, style);
@@ -70,6 +70,7 @@ int			extra_float_digits = 0;		/* Added to DBL_DIG or FLT_DIG */
 
 static int	float4_cmp_internal(float4 a, float4 b);
 static int	float8_cmp_internal(float8 a, float8 b);
+static bool float_out_integral(double num, double limit, char *ascii);
 
 #ifndef HAVE_CBRT
 /*
@@ -185,6 +186,26 @@ is_infinite(double val)
 		return -1;
 }
 
+/*
+ * Output fast path for float4out and float8out.
+ *
+ * An integral value whose digits all fit within the output precision comes
+ * out of "%.*g" as a plain integer, which is much cheaper to produce
+ * ourselves.  The caller passes 10^precision (or less) as limit.  Returns
+ * false, leaving ascii alone, if the value needs the general treatment;
+ * negative zero does, since it prints as "-0".
+ */
+static bool
+float_out_integral(double num, double limit, char *ascii)
+{
+	if (num != rint(num) || fabs(num) >= limit)
+		return false;
+	if (num == 0.0 && 1.0 / num < 0.0)
+		return false;
+	pg_lltoa((int64) num, ascii);
+	return true;
+}
+
 
 /*
  *		float4in		- converts "num" to float4
@@ -350,6 +371,11 @@ float4out(PG_FUNCTION_ARGS)
 			{
 				int			ndig = FLT_DIG + extra_float_digits;
 
+				/* 1e6 is 10^FLT_DIG */
+				if (extra_float_digits >= 0 &&
+					float_out_integral(num, 1e6, ascii))
+					break;
+
 				if (ndig < 1)
 					ndig = 1;
 
@@ -545,6 +571,11 @@ float8out(PG_FUNCTION_ARGS)
 			{
 				int			ndig = DBL_DIG + extra_float_digits;
 
+				/* 1e15 is 10^DBL_DIG */
+				if (extra_float_digits >= 0 &&
+					float_out_integral(num, 1e15, ascii))
+					break;
+
 				if (ndig < 1)
 					ndig = 1;
 
@@ -1855,6 +1886,64 @@ float8_accum(PG_FUNCTION_ARGS)
 	}
 }
 
+/*
+ * float8_combine
+ *
+ * Combine two float8 transition arrays of the form float8_accum produces,
+ * for use in combining partial aggregate states.
+ */
+Datum
+float8_combine(PG_FUNCTION_ARGS)
+{
+	ArrayType  *transarray1 = PG_GETARG_ARRAYTYPE_P(0);
+	ArrayType  *transarray2 = PG_GETARG_ARRAYTYPE_P(1);
+	float8	   *transvalues1;
+	float8	   *transvalues2;
+	float8		N,
+				sumX,
+				sumX2;
+
+	transvalues1 = check_float8_array(transarray1, "float8_combine", 3);
+	transvalues2 = check_float8_array(transarray2, "float8_combine", 3);
+
+	N = transvalues1[0] + transvalues2[0];
+	sumX = transvalues1[1] + transvalues2[1];
+	CHECKFLOATVAL(sumX, isinf(transvalues1[1]) || isinf(transvalues2[1]),
+				  true);
+	sumX2 = transvalues1[2] + transvalues2[2];
+	CHECKFLOATVAL(sumX2, isinf(transvalues1[2]) || isinf(transvalues2[2]),
+				  true);
+
+	/*
+	 * If we're invoked as an aggregate, we can cheat and modify our first
+	 * parameter in-place to reduce palloc overhead. Otherwise we construct a
+	 * new array with the updated transition data and return it.
+	 */
+	if (AggCheckCallContext(fcinfo, NULL))
+	{
+		transvalues1[0] = N;
+		transvalues1[1] = sumX;
+		transvalues1[2] = sumX2;
+
+		PG_RETURN_ARRAYTYPE_P(transarray1);
+	}
+	else
+	{
+		Datum		transdatums[3];
+		ArrayType  *result;
+
+		transdatums[0] = Float8GetDatumFast(N);
+		transdatums[1] = Float8GetDatumFast(sumX);
+		transdatums[2] = Float8GetDatumFast(sumX2);
+
+		result = construct_array(transdatums, 3,
+								 FLOAT8OID,
+								 sizeof(float8), FLOAT8PASSBYVAL, 'd');
+
+		PG_RETURN_ARRAYTYPE_P(result);
+	}
+}
+
 Datum
 float4_accum(PG_FUNCTION_ARGS)
 {
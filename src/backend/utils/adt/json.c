@@ -22,6 +22,7 @@
 #include "mb/pg_wchar.h"
 #include "miscadmin.h"
 #include "parser/parse_coerce.h"
+#include "port/simd.h"
 #include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/date.h"
@@ -690,6 +691,40 @@ json_lex(JsonLexContext *lex)
 		}						/* end of switch */
 }
 
+/*
+ * Return the end of the run of ordinary string characters starting at s,
+ * that is, the first character in [s, end) that is a quote, a backslash or
+ * a control character, or end if there is none.
+ */
+static inline char *
+json_lex_string_run(char *s, char *end)
+{
+#ifdef USE_SSE2
+	Vector8		quote = vector8_broadcast('"');
+	Vector8		backslash = vector8_broadcast('\\');
+	Vector8		control = vector8_broadcast(0x1F);
+
+	while (end - s >= (int) sizeof(Vector8))
+	{
+		Vector8		chunk = vector8_load(s);
+		Vector8		hits;
+		uint32		mask;
+
+		hits = vector8_or(vector8_eq(chunk, quote),
+						  vector8_eq(chunk, backslash));
+		hits = vector8_or(hits, vector8_le(chunk, control));
+		mask = vector8_highbit_mask(hits);
+		if (mask != 0)
+			return s + vector8_mask_first(mask);
+		s += sizeof(Vector8);
+	}
+#endif
+
+	while (s < end && *s != '"' && *s != '\\' && (unsigned char) *s >= 32)
+		s++;
+	return s;
+}
+
 /*
  * The next token in the input stream is known to be a string; lex it.
  */
@@ -908,16 +943,31 @@ json_lex_string(JsonLexContext *lex)
 			}
 
 		}
-		else if (lex->strval != NULL)
+		else
 		{
-			if (hi_surrogate != -1)
-				ereport(ERROR,
-						(errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
-						 errmsg("invalid input syntax for type json"),
-						 errdetail("Unicode low surrogate must follow a high surrogate."),
-						 report_json_context(lex)));
+			/*
+			 * An ordinary character.  Find the end of the run of them that
+			 * starts here, so that we can skip over it (and copy it) in one
+			 * go rather than a character at a time.
+			 */
+			char	   *end = lex->input + lex->input_length;
+			char	   *p = json_lex_string_run(s + 1, end);
+
+			if (lex->strval != NULL)
+			{
+				if (hi_surrogate != -1)
+					ereport(ERROR,
+							(errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+							 errmsg("invalid input syntax for type json"),
+							 errdetail("Unicode low surrogate must follow a high surrogate."),
+							 report_json_context(lex)));
+
+				appendBinaryStringInfo(lex->strval, s, p - s);
+			}
 
-			appendStringInfoChar(lex->strval, *s);
+			/* Continue with the last character of the run */
+			len += p - s - 1;
+			s = p - 1;
 		}
 
 	}
@@ -17,6 +17,7 @@
 #include "catalog/pg_collation.h"
 #include "miscadmin.h"
 #include "utils/builtins.h"
+#include "utils/dynahash.h"
 #include "utils/jsonb.h"
 #include "utils/memutils.h"
 
@@ -55,6 +56,7 @@ static void appendKey(JsonbParseState *pstate, JsonbValue *scalarVal);
 static void appendValue(JsonbParseState *pstate, JsonbValue *scalarVal);
 static void appendElement(JsonbParseState *pstate, JsonbValue *scalarVal);
 static int	lengthCompareJsonbStringValue(const void *a, const void *b);
+static int	lengthCompareJsonbScalarValue(const void *a, const void *b);
 static int	lengthCompareJsonbPair(const void *a, const void *b, void *arg);
 static void uniqueifyJsonbObject(JsonbValue *object);
 static JsonbValue *pushJsonbValueScalar(JsonbParseState **pstate,
@@ -361,52 +363,79 @@ findJsonbValueFromContainer(JsonbContainer *container, uint32 flags,
 	{
 		/* Since this is an object, account for *Pairs* of Jentrys */
 		char	   *base_addr = (char *) (children + count * 2);
-		uint32		stopLow = 0,
-					stopHigh = count;
+		int			index;
 
 		/* Object key passed by caller must be a string */
 		Assert(key->type == jbvString);
 
-		/* Binary search on object/pair keys *only* */
-		while (stopLow < stopHigh)
+		index = findJsonbObjectKeyIndex(container, key->val.string.val,
+										key->val.string.len);
+		if (index >= 0)
 		{
-			uint32		stopMiddle;
-			int			difference;
-			JsonbValue	candidate;
+			/* Found our key, return corresponding value */
+			fillJsonbValue(container, index, base_addr,
+						   getJsonbOffset(container, index),
+						   result);
 
-			stopMiddle = stopLow + (stopHigh - stopLow) / 2;
+			return result;
+		}
+	}
 
-			candidate.type = jbvString;
-			candidate.val.string.val =
-				base_addr + getJsonbOffset(container, stopMiddle);
-			candidate.val.string.len = getJsonbLength(container, stopMiddle);
+	/* Not found */
+	pfree(result);
+	return NULL;
+}
 
-			difference = lengthCompareJsonbStringValue(&candidate, key);
+/*
+ * Find a key in an object container.
+ *
+ * Returns the index of the JEntry of the key's value, or -1 if the object
+ * has no such key.  The search looks only at the JEntrys and the keys, so
+ * callers can use this before the values are available.
+ */
+int
+findJsonbObjectKeyIndex(JsonbContainer *container, char *key, uint32 keylen)
+{
+	int			count = (container->header & JB_CMASK);
+	char	   *base_addr = (char *) (container->children + count * 2);
+	uint32		stopLow = 0,
+				stopHigh = count;
+	JsonbValue	k;
 
-			if (difference == 0)
-			{
-				/* Found our key, return corresponding value */
-				int			index = stopMiddle + count;
+	Assert(container->header & JB_FOBJECT);
 
-				fillJsonbValue(container, index, base_addr,
-							   getJsonbOffset(container, index),
-							   result);
+	k.type = jbvString;
+	k.val.string.val = key;
+	k.val.string.len = keylen;
 
-				return result;
-			}
+	/* Binary search on object/pair keys *only* */
+	while (stopLow < stopHigh)
+	{
+		uint32		stopMiddle;
+		int			difference;
+		JsonbValue	candidate;
+
+		stopMiddle = stopLow + (stopHigh - stopLow) / 2;
+
+		candidate.type = jbvString;
+		candidate.val.string.val =
+			base_addr + getJsonbOffset(container, stopMiddle);
+		candidate.val.string.len = getJsonbLength(container, stopMiddle);
+
+		difference = lengthCompareJsonbStringValue(&candidate, &k);
+
+		if (difference == 0)
+			return stopMiddle + count;
+		else
+		{
+			if (difference < 0)
+				stopLow = stopMiddle + 1;
 			else
-			{
-				if (difference < 0)
-					stopLow = stopMiddle + 1;
-				else
-					stopHigh = stopMiddle;
-			}
+				stopHigh = stopMiddle;
 		}
 	}
 
-	/* Not found */
-	pfree(result);
-	return NULL;
+	return -1;
 }
 
 /*
@@ -1090,11 +1119,26 @@ JsonbDeepContains(JsonbIterator **val, JsonbIterator **mContained)
 	else if (rcont == WJB_BEGIN_ARRAY)
 	{
 		JsonbValue *lhsConts = NULL;
+		JsonbValue *lhsScalars = NULL;
 		uint32		nLhsElems = vval.val.array.nElems;
+		uint32		nLhsConts = 0;
+		uint32		nLhsScalars = 0;
+		bool		lhsCollected = false;
+		bool		sortScalars;
 
 		Assert(vval.type == jbvArray);
 		Assert(vcontained.type == jbvArray);
 
+		/*
+		 * Each scalar on the rhs is normally looked for with a linear scan of
+		 * the lhs array.  When there are enough of them to make it pay off,
+		 * collect the lhs scalars into a sorted array once and binary-search
+		 * that instead, which is what makes "tags @> '[...]'" tolerable on
+		 * long arrays.
+		 */
+		sortScalars = (vcontained.val.array.nElems > 1 &&
+					   vcontained.val.array.nElems > my_log2(nLhsElems));
+
 		/*
 		 * Handle distinction between "raw scalar" pseudo arrays, and real
 		 * arrays.
@@ -1123,48 +1167,64 @@ JsonbDeepContains(JsonbIterator **val, JsonbIterator **mContained)
 
 			Assert(rcont == WJB_ELEM);
 
-			if (IsAJsonbScalar(&vcontained))
-			{
-				if (!findJsonbValueFromContainer((*val)->container,
-												 JB_FARRAY,
-												 &vcontained))
-					return false;
-			}
-			else
+			/*
+			 * If this is the first rhs element (at this depth) that needs
+			 * them, store the lhs elements in temp arrays of containers and,
+			 * if we're going to binary-search them, scalars.
+			 */
+			if (!lhsCollected &&
+				(sortScalars || !IsAJsonbScalar(&vcontained)))
 			{
+				JsonbValue	lhsElem;
 				uint32		i;
 
-				/*
-				 * If this is first container found in rhs array (at this
-				 * depth), initialize temp lhs array of containers
-				 */
-				if (lhsConts == NULL)
+				/* Make room for all possible values */
+				lhsConts = palloc(sizeof(JsonbValue) * nLhsElems);
+				if (sortScalars)
+					lhsScalars = palloc(sizeof(JsonbValue) * nLhsElems);
+
+				for (i = 0; i < nLhsElems; i++)
 				{
-					uint32		j = 0;
+					rcont = JsonbIteratorNext(val, &lhsElem, true);
+					Assert(rcont == WJB_ELEM);
 
-					/* Make room for all possible values */
-					lhsConts = palloc(sizeof(JsonbValue) * nLhsElems);
+					if (lhsElem.type == jbvBinary)
+						lhsConts[nLhsConts++] = lhsElem;
+					else if (sortScalars)
+						lhsScalars[nLhsScalars++] = lhsElem;
+				}
 
-					for (i = 0; i < nLhsElems; i++)
-					{
-						/* Store all lhs elements in temp array */
-						rcont = JsonbIteratorNext(val, &vval, true);
-						Assert(rcont == WJB_ELEM);
+				if (nLhsScalars > 1)
+					qsort(lhsScalars, nLhsScalars, sizeof(JsonbValue),
+						  lengthCompareJsonbScalarValue);
 
-						if (vval.type == jbvBinary)
-							lhsConts[j++] = vval;
-					}
+				lhsCollected = true;
+			}
 
-					/* No container elements in temp array, so give up now */
-					if (j == 0)
+			if (IsAJsonbScalar(&vcontained))
+			{
+				if (sortScalars)
+				{
+					if (!bsearch(&vcontained, lhsScalars, nLhsScalars,
+								 sizeof(JsonbValue),
+								 lengthCompareJsonbScalarValue))
 						return false;
-
-					/* We may have only partially filled array */
-					nLhsElems = j;
 				}
+				else if (!findJsonbValueFromContainer((*val)->container,
+													  JB_FARRAY,
+													  &vcontained))
+					return false;
+			}
+			else
+			{
+				uint32		i;
+
+				/* No container elements in temp array, so give up now */
+				if (nLhsConts == 0)
+					return false;
 
 				/* XXX: Nested array containment is O(N^2) */
-				for (i = 0; i < nLhsElems; i++)
+				for (i = 0; i < nLhsConts; i++)
 				{
 					/* Nested container value (object or array) */
 					JsonbIterator *nestval,
@@ -1188,7 +1248,7 @@ JsonbDeepContains(JsonbIterator **val, JsonbIterator **mContained)
 				 * Report rhs container value is not contained if couldn't
 				 * match rhs container to *some* lhs cont
 				 */
-				if (i == nLhsElems)
+				if (i == nLhsConts)
 					return false;
 			}
 		}
@@ -1736,6 +1796,42 @@ lengthCompareJsonbStringValue(const void *a, const void *b)
 	return res;
 }
 
+/*
+ * qsort() and bsearch() comparator for scalar JsonbValues.
+ *
+ * Values of different types are ordered by type, strings "length-wise" as
+ * above.  Two values compare as equal exactly when equalsJsonbScalarValue()
+ * would say they are, which is all that array containment cares about.
+ */
+static int
+lengthCompareJsonbScalarValue(const void *a, const void *b)
+{
+	const JsonbValue *va = (const JsonbValue *) a;
+	const JsonbValue *vb = (const JsonbValue *) b;
+
+	if (va->type != vb->type)
+		return (va->type > vb->type) ? 1 : -1;
+
+	switch (va->type)
+	{
+		case jbvNull:
+			return 0;
+		case jbvString:
+			return lengthCompareJsonbStringValue(va, vb);
+		case jbvNumeric:
+			return DatumGetInt32(DirectFunctionCall2(numeric_cmp,
+										   PointerGetDatum(va->val.numeric),
+										 PointerGetDatum(vb->val.numeric)));
+		case jbvBool:
+			if (va->val.boolean == vb->val.boolean)
+				return 0;
+			return va->val.boolean ? 1 : -1;
+		default:
+			elog(ERROR, "invalid jsonb scalar type");
+	}
+	return 0;					/* keep compiler quiet */
+}
+
 /*
  * qsort_arg() comparator to compare JsonbPair values.
  *
@@ -17,6 +17,7 @@
 #include <limits.h>
 
 #include "access/htup_details.h"
+#include "access/tuptoaster.h"
 #include "catalog/pg_type.h"
 #include "fmgr.h"
 #include "funcapi.h"
@@ -123,6 +124,8 @@ static JsonbValue *findJsonbValueFromContainerLen(JsonbContainer *container,
 							   uint32 flags,
 							   char *key,
 							   uint32 keylen);
+static JsonbValue *findJsonbRootObjectField(Datum jb, text *key,
+						 DetoastIterator *iter);
 
 /* functions supporting jsonb_delete, jsonb_set and jsonb_concat */
 static JsonbValue *IteratorConcat(JsonbIterator **it1, JsonbIterator **it2,
@@ -488,19 +491,20 @@ json_object_field(PG_FUNCTION_ARGS)
 Datum
 jsonb_object_field(PG_FUNCTION_ARGS)
 {
-	Jsonb	   *jb = PG_GETARG_JSONB(0);
 	text	   *key = PG_GETARG_TEXT_PP(1);
+	DetoastIterator iter;
 	JsonbValue *v;
+	Jsonb	   *result = NULL;
 
-	if (!JB_ROOT_IS_OBJECT(jb))
-		PG_RETURN_NULL();
-
-	v = findJsonbValueFromContainerLen(&jb->root, JB_FOBJECT,
-									   VARDATA_ANY(key),
-									   VARSIZE_ANY_EXHDR(key));
+	v = findJsonbRootObjectField(PG_GETARG_DATUM(0), key, &iter);
 
 	if (v != NULL)
-		PG_RETURN_JSONB(JsonbValueToJsonb(v));
+		result = JsonbValueToJsonb(v);
+
+	free_detoast_iterator(iter);
+
+	if (result != NULL)
+		PG_RETURN_JSONB(result);
 
 	PG_RETURN_NULL();
 }
@@ -524,20 +528,15 @@ json_object_field_text(PG_FUNCTION_ARGS)
 Datum
 jsonb_object_field_text(PG_FUNCTION_ARGS)
 {
-	Jsonb	   *jb = PG_GETARG_JSONB(0);
 	text	   *key = PG_GETARG_TEXT_PP(1);
+	DetoastIterator iter;
 	JsonbValue *v;
+	text	   *result = NULL;
 
-	if (!JB_ROOT_IS_OBJECT(jb))
-		PG_RETURN_NULL();
-
-	v = findJsonbValueFromContainerLen(&jb->root, JB_FOBJECT,
-									   VARDATA_ANY(key),
-									   VARSIZE_ANY_EXHDR(key));
+	v = findJsonbRootObjectField(PG_GETARG_DATUM(0), key, &iter);
 
 	if (v != NULL)
 	{
-		text	   *result = NULL;
 
 		switch (v->type)
 		{
@@ -564,11 +563,13 @@ jsonb_object_field_text(PG_FUNCTION_ARGS)
 			default:
 				elog(ERROR, "unrecognized jsonb type: %d", (int) v->type);
 		}
-
-		if (result)
-			PG_RETURN_TEXT_P(result);
 	}
 
+	free_detoast_iterator(iter);
+
+	if (result)
+		PG_RETURN_TEXT_P(result);
+
 	PG_RETURN_NULL();
 }
 
@@ -3034,6 +3035,51 @@ findJsonbValueFromContainerLen(JsonbContainer *container, uint32 flags,
 	return findJsonbValueFromContainer(container, flags, &k);
 }
 
+/*
+ * Look up a key in the root object of a jsonb datum.
+ *
+ * The datum is detoasted only as far as the lookup needs: the JEntrys, the
+ * keys, and then the value found, if any.  So a lookup in a large document
+ * that's stored out of line or compressed needn't detoast all of it, as
+ * long as the value is small, since the keys are stored before the values.
+ *
+ * *iter is set to the iterator holding the detoasted data.  The result
+ * points into it, so the caller must free it only after using the result.
+ */
+static JsonbValue *
+findJsonbRootObjectField(Datum jb, text *key, DetoastIterator *iter)
+{
+	JsonbContainer *root;
+	uint32		count;
+	int32		entries_end;
+	int			index;
+
+	*iter = create_detoast_iterator((struct varlena *) DatumGetPointer(jb));
+
+	detoast_iterate_to(*iter, sizeof(uint32));
+	root = (JsonbContainer *) VARDATA((*iter)->buf);
+	if ((root->header & JB_FOBJECT) == 0)
+		return NULL;
+
+	count = root->header & JB_CMASK;
+	entries_end = offsetof(JsonbContainer, children) +
+		count * 2 * sizeof(JEntry);
+	detoast_iterate_to(*iter, entries_end);
+	detoast_iterate_to(*iter, entries_end + getJsonbOffset(root, count));
+
+	index = findJsonbObjectKeyIndex(root, VARDATA_ANY(key),
+									VARSIZE_ANY_EXHDR(key));
+	if (index < 0)
+		return NULL;
+
+	detoast_iterate_to(*iter, entries_end + getJsonbOffset(root, index) +
+					   getJsonbLength(root, index));
+
+	return findJsonbValueFromContainerLen(root, JB_FOBJECT,
+										  VARDATA_ANY(key),
+										  VARSIZE_ANY_EXHDR(key));
+}
+
 /*
  * Semantic actions for json_strip_nulls.
  *
@@ -19,8 +19,20 @@
 
 #include <ctype.h>
 
+/*
+ * towlower() and friends should be in <wctype.h>, but some pre-C99 systems
+ * declare them in <wchar.h>.
+ */
+#ifdef HAVE_WCHAR_H
+#include <wchar.h>
+#endif
+#ifdef HAVE_WCTYPE_H
+#include <wctype.h>
+#endif
+
 #include "catalog/pg_collation.h"
 #include "mb/pg_wchar.h"
+#include "port/simd.h"
 #include "utils/builtins.h"
 #include "utils/pg_locale.h"
 
@@ -29,6 +41,24 @@
 #define LIKE_FALSE						0
 #define LIKE_ABORT						(-1)
 
+/*
+ * Shapes of LIKE pattern that are matched with a plain search for their
+ * literal part, rather than with MatchText.  The literal must not contain
+ * any wildcards or escapes.
+ */
+typedef enum
+{
+	LIKE_SHAPE_OTHER,			/* anything else */
+	LIKE_SHAPE_PREFIX,			/* literal% */
+	LIKE_SHAPE_SUFFIX,			/* %literal */
+	LIKE_SHAPE_CONTAINS			/* %literal% */
+} LikeShape;
+
+#define IS_ASCII_LETTER(c) \
+	((((c) | 0x20) >= 'a') && (((c) | 0x20) <= 'z'))
+#define ASCII_LOWER(c) \
+	(((c) >= 'A' && (c) <= 'Z') ? (char) ((c) + ('a' - 'A')) : (c))
+
 
 static int SB_MatchText(char *t, int tlen, char *p, int plen,
 			 pg_locale_t locale, bool locale_is_c);
@@ -45,6 +75,16 @@ static int SB_IMatchText(char *t, int tlen, char *p, int plen,
 			  pg_locale_t locale, bool locale_is_c);
 
 static int	GenericMatchText(char *s, int slen, char *p, int plen);
+static LikeShape like_pattern_shape(char *p, int plen, char **lit,
+				   int *litlen);
+static bool like_find_literal(const char *s, int slen, const char *lit,
+				  int litlen, bool icase);
+static bool like_simple_match(char *s, int slen, char *p, int plen,
+				  bool icase, bool unanchored_ok, int *result);
+static bool like_ascii_fold_ok(Oid collation);
+static bool like_is_ascii(const char *s, int len);
+static struct varlena *like_fetch_string(Datum str, char *p, int plen,
+				  int max_char_len);
 static int	Generic_Text_IC_like(text *str, text *pat, Oid collation);
 
 /*--------------------
@@ -145,16 +185,317 @@ SB_lower_char(unsigned char c, pg_locale_t locale, bool locale_is_c)
 
 #include "like_match.c"
 
+/*
+ * Classify a LIKE pattern, and return its literal part in *lit and *litlen.
+ */
+static LikeShape
+like_pattern_shape(char *p, int plen, char **lit, int *litlen)
+{
+	int			lead = 0;
+	int			trail = 0;
+	int			i;
+
+	while (lead < plen && p[lead] == '%')
+		lead++;
+	while (trail < plen - lead && p[plen - 1 - trail] == '%')
+		trail++;
+
+	*lit = p + lead;
+	*litlen = plen - lead - trail;
+	if (*litlen == 0)
+		return LIKE_SHAPE_OTHER;
+
+	for (i = lead; i < plen - trail; i++)
+	{
+		if (p[i] == '%' || p[i] == '_' || p[i] == '\\')
+			return LIKE_SHAPE_OTHER;
+	}
+
+	if (lead > 0 && trail > 0)
+		return LIKE_SHAPE_CONTAINS;
+	else if (lead > 0)
+		return LIKE_SHAPE_SUFFIX;
+	else if (trail > 0)
+		return LIKE_SHAPE_PREFIX;
+	else
+		return LIKE_SHAPE_OTHER;	/* MatchText is as quick for these */
+}
+
+/*
+ * Compare litlen bytes of s and lit, folding ASCII letters if icase.
+ */
+static inline bool
+like_literal_eq(const char *s, const char *lit, int litlen, bool icase)
+{
+	int			i;
+
+	if (!icase)
+		return memcmp(s, lit, litlen) == 0;
+
+	for (i = 0; i < litlen; i++)
+	{
+		if (ASCII_LOWER(s[i]) != ASCII_LOWER(lit[i]))
+			return false;
+	}
+	return true;
+}
+
+#ifdef USE_SSE2
+/*
+ * Bytewise test of chunk for the byte c, or for either case of it if it's
+ * an ASCII letter and icase.  'cvec' is c broadcast, with the 0x20 bit set
+ * in the case-insensitive case.
+ */
+static inline Vector8
+like_vector_eq(Vector8 chunk, Vector8 cvec, bool fold)
+{
+	if (fold)
+		chunk = vector8_or(chunk, vector8_broadcast(0x20));
+	return vector8_eq(chunk, cvec);
+}
+#endif
+
+/*
+ * Search s for the byte string lit, ignoring the case of ASCII letters if
+ * icase.  With SSE2, candidate positions are found a vector at a time by
+ * testing for the first and last bytes of lit, and only those are compared
+ * in full.
+ */
+static bool
+like_find_literal(const char *s, int slen, const char *lit, int litlen,
+				  bool icase)
+{
+	int			last = slen - litlen;	/* last possible start of a match */
+	int			i = 0;
+
+	if (last < 0)
+		return false;
+
+#ifdef USE_SSE2
+	{
+		char		c1 = lit[0];
+		char		c2 = lit[litlen - 1];
+		bool		fold1 = icase && IS_ASCII_LETTER(c1);
+		bool		fold2 = icase && IS_ASCII_LETTER(c2);
+		Vector8		first = vector8_broadcast(fold1 ? (c1 | 0x20) : c1);
+		Vector8		lastc = vector8_broadcast(fold2 ? (c2 | 0x20) : c2);
+
+		for (; i + (int) sizeof(Vector8) - 1 <= last; i += sizeof(Vector8))
+		{
+			Vector8		hits;
+			uint32		mask;
+
+			hits = vector8_and(like_vector_eq(vector8_load(s + i),
+											  first, fold1),
+							   like_vector_eq(vector8_load(s + i + litlen - 1),
+											  lastc, fold2));
+			mask = vector8_highbit_mask(hits);
+			while (mask != 0)
+			{
+				int			pos = i + vector8_mask_first(mask);
+
+				if (like_literal_eq(s + pos, lit, litlen, icase))
+					return true;
+				mask &= mask - 1;
+			}
+		}
+	}
+#endif
+
+	for (; i <= last; i++)
+	{
+		if (like_literal_eq(s + i, lit, litlen, icase))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Match s against p if p has one of the simple shapes, setting *result to
+ * LIKE_TRUE or LIKE_FALSE and returning true; otherwise return false.
+ *
+ * A prefix match is always aligned on character boundaries, but a match
+ * found elsewhere is only known to be when the caller says unanchored_ok:
+ * in single-byte encodings, and in UTF8, which is self-synchronizing.
+ * icase folds ASCII letters only, so it's only valid for ASCII input.
+ */
+static bool
+like_simple_match(char *s, int slen, char *p, int plen,
+				  bool icase, bool unanchored_ok, int *result)
+{
+	char	   *lit;
+	int			litlen;
+	bool		match;
+
+	switch (like_pattern_shape(p, plen, &lit, &litlen))
+	{
+		case LIKE_SHAPE_PREFIX:
+			match = (slen >= litlen &&
+					 like_literal_eq(s, lit, litlen, icase));
+			break;
+		case LIKE_SHAPE_SUFFIX:
+			if (!unanchored_ok)
+				return false;
+			match = (slen >= litlen &&
+					 like_literal_eq(s + slen - litlen, lit, litlen, icase));
+			break;
+		case LIKE_SHAPE_CONTAINS:
+			if (!unanchored_ok)
+				return false;
+			match = like_find_literal(s, slen, lit, litlen, icase);
+			break;
+		default:
+			return false;
+	}
+
+	*result = match ? LIKE_TRUE : LIKE_FALSE;
+	return true;
+}
+
 /* Generic for all cases not requiring inline case-folding */
 static inline int
 GenericMatchText(char *s, int slen, char *p, int plen)
 {
+	int			result;
+
 	if (pg_database_encoding_max_length() == 1)
+	{
+		if (like_simple_match(s, slen, p, plen, false, true, &result))
+			return result;
 		return SB_MatchText(s, slen, p, plen, 0, true);
+	}
 	else if (GetDatabaseEncoding() == PG_UTF8)
+	{
+		if (like_simple_match(s, slen, p, plen, false, true, &result))
+			return result;
 		return UTF8_MatchText(s, slen, p, plen, 0, true);
+	}
 	else
+	{
+		if (like_simple_match(s, slen, p, plen, false, false, &result))
+			return result;
 		return MB_MatchText(s, slen, p, plen, 0, true);
+	}
+}
+
+/*
+ * Does the collation lowercase every ASCII character the same way as
+ * pg_ascii_tolower()?  If so, ILIKE on pure-ASCII input can fold case on the
+ * fly instead of calling lower().  The tests mirror those in str_tolower()
+ * and SB_lower_char().  Turkish locales, for one, fail them.  The answer for
+ * the last collation asked about is remembered.
+ */
+static bool
+like_ascii_fold_ok(Oid collation)
+{
+	static Oid	cached_collation = InvalidOid;
+	static bool cached_result = false;
+	pg_locale_t locale = 0;
+	bool		result = true;
+	int			c;
+
+	/* Let the regular code path complain about a missing collation */
+	if (!OidIsValid(collation))
+		return false;
+	if (lc_ctype_is_c(collation))
+		return true;
+	if (collation == cached_collation)
+		return cached_result;
+
+	if (collation != DEFAULT_COLLATION_OID)
+		locale = pg_newlocale_from_collation(collation);
+
+	for (c = 1; c < 128 && result; c++)
+	{
+		int			lowered;
+
+#ifdef USE_WIDE_UPPER_LOWER
+		if (pg_database_encoding_max_length() > 1)
+		{
+#ifdef HAVE_LOCALE_T
+			if (locale)
+				lowered = towlower_l((wint_t) c, locale);
+			else
+#endif
+				lowered = towlower((wint_t) c);
+		}
+		else
+#endif   /* USE_WIDE_UPPER_LOWER */
+		{
+#ifdef HAVE_LOCALE_T
+			if (locale)
+				lowered = tolower_l(c, locale);
+			else
+#endif
+				lowered = pg_tolower((unsigned char) c);
+		}
+
+		if (lowered != ASCII_LOWER(c))
+			result = false;
+	}
+
+	cached_collation = collation;
+	cached_result = result;
+	return result;
+}
+
+/* Are all of the len bytes at s ASCII? */
+static bool
+like_is_ascii(const char *s, int len)
+{
+	int			i = 0;
+
+#ifdef USE_SSE2
+	for (; i + (int) sizeof(Vector8) <= len; i += sizeof(Vector8))
+	{
+		if (vector8_highbit_mask(vector8_load(s + i)) != 0)
+			return false;
+	}
+#endif
+
+	for (; i < len; i++)
+	{
+		if (IS_HIGHBIT_SET(s[i]))
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Fetch the string argument of a LIKE operator.  If the string is stored out
+ * of line or compressed, and the pattern's only unescaped '%'s are at its
+ * end, matching can look at no more characters than there are bytes before
+ * the first '%', so only that much of the string is detoasted.
+ */
+static struct varlena *
+like_fetch_string(Datum str, char *p, int plen, int max_char_len)
+{
+	struct varlena *s = (struct varlena *) DatumGetPointer(str);
+	int			i;
+
+	if (!VARATT_IS_EXTERNAL(s) && !VARATT_IS_COMPRESSED(s))
+		return pg_detoast_datum_packed(s);
+
+	for (i = 0; i < plen; i++)
+	{
+		if (p[i] == '\\')
+			i++;
+		else if (p[i] == '%')
+		{
+			int			j;
+
+			for (j = i + 1; j < plen; j++)
+			{
+				if (p[j] != '%')
+					return pg_detoast_datum_packed(s);
+			}
+			if (i > PG_INT32_MAX / max_char_len)
+				break;
+			return pg_detoast_datum_slice(s, 0, i * max_char_len);
+		}
+	}
+
+	return pg_detoast_datum_packed(s);
 }
 
 static inline int
@@ -164,6 +505,24 @@ Generic_Text_IC_like(text *str, text *pat, Oid collation)
 			   *p;
 	int			slen,
 				plen;
+	int			result;
+
+	/*
+	 * If both strings are pure ASCII, and the collation folds ASCII the
+	 * ASCII way, we can fold case on the fly whatever the encoding.  That
+	 * also lets the simple pattern shapes be searched for directly.
+	 */
+	p = VARDATA_ANY(pat);
+	plen = VARSIZE_ANY_EXHDR(pat);
+	s = VARDATA_ANY(str);
+	slen = VARSIZE_ANY_EXHDR(str);
+	if (like_ascii_fold_ok(collation) &&
+		like_is_ascii(p, plen) && like_is_ascii(s, slen))
+	{
+		if (like_simple_match(s, slen, p, plen, true, true, &result))
+			return result;
+		return SB_IMatchText(s, slen, p, plen, 0, true);
+	}
 
 	/*
 	 * For efficiency reasons, in the single byte case we don't call lower()
@@ -271,7 +630,7 @@ namenlike(PG_FUNCTION_ARGS)
 Datum
 textlike(PG_FUNCTION_ARGS)
 {
-	text	   *str = PG_GETARG_TEXT_PP(0);
+	text	   *str;
 	text	   *pat = PG_GETARG_TEXT_PP(1);
 	bool		result;
 	char	   *s,
@@ -279,10 +638,12 @@ textlike(PG_FUNCTION_ARGS)
 	int			slen,
 				plen;
 
-	s = VARDATA_ANY(str);
-	slen = VARSIZE_ANY_EXHDR(str);
 	p = VARDATA_ANY(pat);
 	plen = VARSIZE_ANY_EXHDR(pat);
+	str = (text *) like_fetch_string(PG_GETARG_DATUM(0), p, plen,
+									 pg_database_encoding_max_length());
+	s = VARDATA_ANY(str);
+	slen = VARSIZE_ANY_EXHDR(str);
 
 	result = (GenericMatchText(s, slen, p, plen) == LIKE_TRUE);
 
@@ -292,7 +653,7 @@ textlike(PG_FUNCTION_ARGS)
 Datum
 textnlike(PG_FUNCTION_ARGS)
 {
-	text	   *str = PG_GETARG_TEXT_PP(0);
+	text	   *str;
 	text	   *pat = PG_GETARG_TEXT_PP(1);
 	bool		result;
 	char	   *s,
@@ -300,10 +661,12 @@ textnlike(PG_FUNCTION_ARGS)
 	int			slen,
 				plen;
 
-	s = VARDATA_ANY(str);
-	slen = VARSIZE_ANY_EXHDR(str);
 	p = VARDATA_ANY(pat);
 	plen = VARSIZE_ANY_EXHDR(pat);
+	str = (text *) like_fetch_string(PG_GETARG_DATUM(0), p, plen,
+									 pg_database_encoding_max_length());
+	s = VARDATA_ANY(str);
+	slen = VARSIZE_ANY_EXHDR(str);
 
 	result = (GenericMatchText(s, slen, p, plen) != LIKE_TRUE);
 
@@ -313,20 +676,24 @@ textnlike(PG_FUNCTION_ARGS)
 Datum
 bytealike(PG_FUNCTION_ARGS)
 {
-	bytea	   *str = PG_GETARG_BYTEA_PP(0);
+	bytea	   *str;
 	bytea	   *pat = PG_GETARG_BYTEA_PP(1);
 	bool		result;
+	int			match;
 	char	   *s,
 			   *p;
 	int			slen,
 				plen;
 
-	s = VARDATA_ANY(str);
-	slen = VARSIZE_ANY_EXHDR(str);
 	p = VARDATA_ANY(pat);
 	plen = VARSIZE_ANY_EXHDR(pat);
+	str = (bytea *) like_fetch_string(PG_GETARG_DATUM(0), p, plen, 1);
+	s = VARDATA_ANY(str);
+	slen = VARSIZE_ANY_EXHDR(str);
 
-	result = (SB_MatchText(s, slen, p, plen, 0, true) == LIKE_TRUE);
+	if (!like_simple_match(s, slen, p, plen, false, true, &match))
+		match = SB_MatchText(s, slen, p, plen, 0, true);
+	result = (match == LIKE_TRUE);
 
 	PG_RETURN_BOOL(result);
 }
@@ -334,20 +701,24 @@ bytealike(PG_FUNCTION_ARGS)
 Datum
 byteanlike(PG_FUNCTION_ARGS)
 {
-	bytea	   *str = PG_GETARG_BYTEA_PP(0);
+	bytea	   *str;
 	bytea	   *pat = PG_GETARG_BYTEA_PP(1);
 	bool		result;
+	int			match;
 	char	   *s,
 			   *p;
 	int			slen,
 				plen;
 
-	s = VARDATA_ANY(str);
-	slen = VARSIZE_ANY_EXHDR(str);
 	p = VARDATA_ANY(pat);
 	plen = VARSIZE_ANY_EXHDR(pat);
+	str = (bytea *) like_fetch_string(PG_GETARG_DATUM(0), p, plen, 1);
+	s = VARDATA_ANY(str);
+	slen = VARSIZE_ANY_EXHDR(str);
 
-	result = (SB_MatchText(s, slen, p, plen, 0, true) != LIKE_TRUE);
+	if (!like_simple_match(s, slen, p, plen, false, true, &match))
+		match = SB_MatchText(s, slen, p, plen, 0, true);
+	result = (match != LIKE_TRUE);
 
 	PG_RETURN_BOOL(result);
 }
@@ -28,6 +28,7 @@
 #include "funcapi.h"
 #include "miscadmin.h"
 #include "parser/keywords.h"
+#include "pgstat.h"
 #include "postmaster/syslogger.h"
 #include "rewrite/rewriteHandler.h"
 #include "storage/fd.h"
@@ -438,9 +439,11 @@ pg_sleep(PG_FUNCTION_ARGS)
 		else
 			break;
 
+		pgstat_report_wait_start(WAIT_EVENT_PG_SLEEP);
 		(void) WaitLatch(MyLatch,
 						 WL_LATCH_SET | WL_TIMEOUT,
 						 delay_ms);
+		pgstat_report_wait_end();
 		ResetLatch(MyLatch);
 	}
 
@@ -14,15 +14,31 @@
 
 #include "access/hash.h"
 #include "catalog/pg_type.h"
+#include "lib/hyperloglog.h"
 #include "libpq/ip.h"
 #include "libpq/libpq-be.h"
 #include "libpq/pqformat.h"
 #include "miscadmin.h"
 #include "utils/builtins.h"
+#include "utils/guc.h"
 #include "utils/inet.h"
+#include "utils/sortsupport.h"
+
+/* sortsupport for inet/cidr */
+typedef struct
+{
+	int64		input_count;	/* number of non-null values seen */
+	bool		estimating;		/* true if estimating cardinality */
+
+	hyperLogLogState abbr_card; /* cardinality estimator */
+} network_sortsupport_state;
 
 
 static int32 network_cmp_internal(inet *a1, inet *a2);
+static int	network_fast_cmp(Datum x, Datum y, SortSupport ssup);
+static int	network_cmp_abbrev(Datum x, Datum y, SortSupport ssup);
+static bool network_abbrev_abort(int memtupcount, SortSupport ssup);
+static Datum network_abbrev_convert(Datum original, SortSupport ssup);
 static bool addressOK(unsigned char *a, int bits, int family);
 static inet *internal_inetpl(inet *ip, int64 addend);
 
@@ -414,6 +430,233 @@ network_cmp(PG_FUNCTION_ARGS)
 	PG_RETURN_INT32(network_cmp_internal(a1, a2));
 }
 
+/*
+ * Sort support strategy routine
+ *
+ * The abbreviated key packs the address family, the network part of the
+ * address and (where there is room) the netmask length and the leading host
+ * bits into a Datum, so that an unsigned comparison of two keys agrees with
+ * network_cmp_internal() whenever the keys differ.
+ */
+Datum
+network_sortsupport(PG_FUNCTION_ARGS)
+{
+	SortSupport ssup = (SortSupport) PG_GETARG_POINTER(0);
+
+	ssup->comparator = network_fast_cmp;
+	ssup->ssup_extra = NULL;
+
+	if (ssup->abbreviate)
+	{
+		network_sortsupport_state *nss;
+		MemoryContext oldcontext;
+
+		oldcontext = MemoryContextSwitchTo(ssup->ssup_cxt);
+
+		nss = palloc(sizeof(network_sortsupport_state));
+		nss->input_count = 0;
+		nss->estimating = true;
+		initHyperLogLog(&nss->abbr_card, 10);
+
+		ssup->ssup_extra = nss;
+
+		ssup->abbrev_full_comparator = ssup->comparator;
+		ssup->comparator = network_cmp_abbrev;
+		ssup->abbrev_converter = network_abbrev_convert;
+		ssup->abbrev_abort = network_abbrev_abort;
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * SortSupport comparison func
+ */
+static int
+network_fast_cmp(Datum x, Datum y, SortSupport ssup)
+{
+	inet	   *arg1 = DatumGetInetPP(x);
+	inet	   *arg2 = DatumGetInetPP(y);
+	int			result;
+
+	result = network_cmp_internal(arg1, arg2);
+
+	/* We can't afford to leak memory here. */
+	if (PointerGetDatum(arg1) != x)
+		pfree(arg1);
+	if (PointerGetDatum(arg2) != y)
+		pfree(arg2);
+
+	return result;
+}
+
+/*
+ * Abbreviated key comparison func
+ */
+static int
+network_cmp_abbrev(Datum x, Datum y, SortSupport ssup)
+{
+	if (x > y)
+		return 1;
+	else if (x == y)
+		return 0;
+	else
+		return -1;
+}
+
+/*
+ * Callback for estimating effectiveness of abbreviated key optimization.
+ *
+ * This follows the same heuristic as numeric_abbrev_abort().
+ */
+static bool
+network_abbrev_abort(int memtupcount, SortSupport ssup)
+{
+	network_sortsupport_state *nss = ssup->ssup_extra;
+	double		abbr_card;
+
+	if (memtupcount < 10000 || nss->input_count < 10000 || !nss->estimating)
+		return false;
+
+	abbr_card = estimateHyperLogLog(&nss->abbr_card);
+
+	/*
+	 * Once we've seen >100k distinct abbreviated keys, abbreviation is all
+	 * but certain to pay off, so stop counting.
+	 */
+	if (abbr_card > 100000.0)
+	{
+#ifdef TRACE_SORT
+		if (trace_sort)
+			elog(LOG,
+				 "network_abbrev: estimation ends at cardinality %f"
+				 " after " INT64_FORMAT " values (%d rows)",
+				 abbr_card, nss->input_count, memtupcount);
+#endif
+		nss->estimating = false;
+		return false;
+	}
+
+	/*
+	 * Target minimum cardinality is 1 per ~2k of non-null inputs, as for
+	 * numeric.
+	 */
+	if (abbr_card < nss->input_count / 2000.0 + 0.5)
+	{
+#ifdef TRACE_SORT
+		if (trace_sort)
+			elog(LOG,
+				 "network_abbrev: aborting abbreviation at cardinality %f"
+			   " below threshold %f after " INT64_FORMAT " values (%d rows)",
+				 abbr_card, nss->input_count / 2000.0 + 0.5,
+				 nss->input_count, memtupcount);
+#endif
+		return true;
+	}
+
+#ifdef TRACE_SORT
+	if (trace_sort)
+		elog(LOG,
+			 "network_abbrev: cardinality %f after " INT64_FORMAT
+			 " values (%d rows)", abbr_card, nss->input_count, memtupcount);
+#endif
+
+	return false;
+}
+
+/*
+ * Conversion routine for sortsupport.
+ *
+ * The most significant bit of the key is the address family, zero for IPv4
+ * and one for IPv6, matching the family ordering of network_cmp_internal().
+ * The remaining bits hold the network part of the address, that is the
+ * address with the bits to the right of the netmask cleared.  Comparing
+ * masked networks gives the same result as comparing the common prefix and
+ * then the netmask length, because a shorter netmask leaves more trailing
+ * zeroes.
+ *
+ * On 64-bit platforms an IPv4 key has room left over, so it is laid out as:
+ *
+ *	[1 bit family] [32 bits network] [6 bits netmask length] [25 bits host]
+ *
+ * where the host bits are the leading bits of the part of the address to the
+ * right of the netmask.  Those are only compared once the network and netmask
+ * length are equal, exactly as network_cmp_internal() does.  IPv6 keys, and
+ * all keys on 32-bit platforms, hold as much of the network part as fits.
+ */
+static Datum
+network_abbrev_convert(Datum original, SortSupport ssup)
+{
+	network_sortsupport_state *nss = ssup->ssup_extra;
+	inet	   *authoritative = DatumGetInetPP(original);
+	unsigned char *addr = ip_addr(authoritative);
+	int			bits = ip_bits(authoritative);
+	Datum		res;
+	uint32		hash;
+
+	if (ip_family(authoritative) == PGSQL_AF_INET)
+	{
+		uint32		ipaddr;
+		uint32		netmask;
+
+		ipaddr = ((uint32) addr[0] << 24) | ((uint32) addr[1] << 16) |
+			((uint32) addr[2] << 8) | (uint32) addr[3];
+		netmask = (bits == 0) ? 0 : ~((uint32) 0) << (32 - bits);
+
+#if SIZEOF_DATUM == 8
+		{
+			uint32		host = ipaddr & ~netmask;
+
+			/* keep only the leading 25 host bits */
+			if (bits < 7)
+				host >>= (7 - bits);
+
+			res = ((uint64) (ipaddr & netmask) << 31) |
+				((uint64) bits << 25) |
+				(uint64) host;
+		}
+#else							/* SIZEOF_DATUM != 8 */
+		res = (Datum) ((ipaddr & netmask) >> 1);
+#endif
+	}
+	else
+	{
+		Datum		prefix = 0;
+		int			i;
+
+		for (i = 0; i < sizeof(Datum); i++)
+			prefix = (prefix << 8) | addr[i];
+
+		if (bits < SIZEOF_DATUM * BITS_PER_BYTE)
+			prefix &= (bits == 0) ? 0 :
+				~((Datum) 0) << (SIZEOF_DATUM * BITS_PER_BYTE - bits);
+
+		res = ((Datum) 1 << (SIZEOF_DATUM * BITS_PER_BYTE - 1)) |
+			(prefix >> 1);
+	}
+
+	nss->input_count += 1;
+
+	if (nss->estimating)
+	{
+#if SIZEOF_DATUM == 8
+		hash = (uint32) res ^ (uint32) ((uint64) res >> 32);
+#else							/* SIZEOF_DATUM != 8 */
+		hash = (uint32) res;
+#endif
+
+		addHyperLogLog(&nss->abbr_card, DatumGetUInt32(hash_uint32(hash)));
+	}
+
+	/* Don't leak memory here */
+	if (PointerGetDatum(authoritative) != original)
+		pfree(authoritative);
+
+	return res;
+}
+
 /*
  *	Boolean ordering tests.
  */
@@ -106,6 +106,108 @@ pg_atoi(const char *s, int size, int c)
 	return (int32) l;
 }
 
+/*
+ * Two-digit decimal strings for the numbers 0..99, so that the conversions
+ * below need one division per pair of digits rather than per digit.
+ */
+static const char digit_pairs[200] =
+"00010203040506070809"
+"10111213141516171819"
+"20212223242526272829"
+"30313233343536373839"
+"40414243444546474849"
+"50515253545556575859"
+"60616263646566676869"
+"70717273747576777879"
+"80818283848586878889"
+"90919293949596979899";
+
+/* Number of decimal digits in value */
+static inline int
+decimal_length32(uint32 value)
+{
+	int			len = 1;
+
+	while (value >= 10000)
+	{
+		value /= 10000;
+		len += 4;
+	}
+	if (value >= 100)
+	{
+		value /= 100;
+		len += 2;
+	}
+	if (value >= 10)
+		len++;
+	return len;
+}
+
+/*
+ * pg_ultoa_n: write the decimal digits of an unsigned 32-bit integer
+ *
+ * Writes exactly decimal_length32(value) digits to 'a', without a trailing
+ * NUL, and returns the number of digits written (at most 10).
+ */
+static int
+pg_ultoa_n(uint32 value, char *a)
+{
+	int			len = decimal_length32(value);
+	char	   *p = a + len;
+
+	while (value >= 100)
+	{
+		uint32		pair = value % 100;
+
+		value /= 100;
+		p -= 2;
+		memcpy(p, digit_pairs + 2 * pair, 2);
+	}
+	if (value >= 10)
+		memcpy(p - 2, digit_pairs + 2 * value, 2);
+	else
+		*--p = '0' + value;
+
+	return len;
+}
+
+/*
+ * pg_ulltoa_n: as above, for an unsigned 64-bit integer (at most 20 digits)
+ *
+ * 64-bit division is slow on many platforms, so we only do it to split off
+ * chunks of eight digits, and format those with 32-bit arithmetic.
+ */
+static int
+pg_ulltoa_n(uint64 value, char *a)
+{
+	char		chunks[2][8];
+	int			nchunks = 0;
+	int			len;
+	int			i;
+
+	while (value > PG_UINT32_MAX)
+	{
+		uint32		low = (uint32) (value % 100000000);
+		char	   *p = chunks[nchunks++] + 8;
+
+		value /= 100000000;
+		for (i = 0; i < 4; i++)
+		{
+			p -= 2;
+			memcpy(p, digit_pairs + 2 * (low % 100), 2);
+			low /= 100;
+		}
+	}
+
+	len = pg_ultoa_n((uint32) value, a);
+	while (nchunks > 0)
+	{
+		memcpy(a + len, chunks[--nchunks], 8);
+		len += 8;
+	}
+	return len;
+}
+
 /*
  * pg_itoa: converts a signed 16-bit integer to its string representation
  *
@@ -124,54 +226,24 @@ pg_itoa(int16 i, char *a)
  * pg_ltoa: converts a signed 32-bit integer to its string representation
  *
  * Caller must ensure that 'a' points to enough memory to hold the result
- * (at least 12 bytes, counting a leading sign and trailing NUL).
+ * (at least 12 bytes, counting a leading sign and trailing NUL).  Returns
+ * the length of the result, not counting the NUL.
  */
-void
+int
 pg_ltoa(int32 value, char *a)
 {
-	char	   *start = a;
-	bool		neg = false;
+	uint32		uvalue = (uint32) value;
+	int			len = 0;
 
-	/*
-	 * Avoid problems with the most negative integer not being representable
-	 * as a positive integer.
-	 */
-	if (value == (-2147483647 - 1))
+	/* this works for the most negative integer too */
+	if (value < 0)
 	{
-		memcpy(a, "-2147483648", 12);
-		return;
-	}
-	else if (value < 0)
-	{
-		value = -value;
-		neg = true;
-	}
-
-	/* Compute the result string backwards. */
-	do
-	{
-		int32		remainder;
-		int32		oldval = value;
-
-		value /= 10;
-		remainder = oldval - value * 10;
-		*a++ = '0' + remainder;
-	} while (value != 0);
-
-	if (neg)
-		*a++ = '-';
-
-	/* Add trailing NUL byte, and back up 'a' to the last character. */
-	*a-- = '\0';
-
-	/* Reverse string. */
-	while (start < a)
-	{
-		char		swap = *start;
-
-		*start++ = *a;
-		*a-- = swap;
+		uvalue = (uint32) 0 - uvalue;
+		a[len++] = '-';
 	}
+	len += pg_ultoa_n(uvalue, a + len);
+	a[len] = '\0';
+	return len;
 }
 
 /*
@@ -179,51 +251,49 @@ pg_ltoa(int32 value, char *a)
  *
  * Caller must ensure that 'a' points to enough memory to hold the result
  * (at least MAXINT8LEN+1 bytes, counting a leading sign and trailing NUL).
+ * Returns the length of the result, not counting the NUL.
  */
-void
+int
 pg_lltoa(int64 value, char *a)
 {
-	char	   *start = a;
-	bool		neg = false;
+	uint64		uvalue = (uint64) value;
+	int			len = 0;
 
-	/*
-	 * Avoid problems with the most negative integer not being representable
-	 * as a positive integer.
-	 */
-	if (value == PG_INT64_MIN)
-	{
-		memcpy(a, "-9223372036854775808", 21);
-		return;
-	}
-	else if (value < 0)
+	if (value < 0)
 	{
-		value = -value;
-		neg = true;
+		uvalue = (uint64) 0 - uvalue;
+		a[len++] = '-';
 	}
+	len += pg_ulltoa_n(uvalue, a + len);
+	a[len] = '\0';
+	return len;
+}
 
-	/* Compute the result string backwards. */
-	do
-	{
-		int64		remainder;
-		int64		oldval = value;
-
-		value /= 10;
-		remainder = oldval - value * 10;
-		*a++ = '0' + remainder;
-	} while (value != 0);
-
-	if (neg)
-		*a++ = '-';
-
-	/* Add trailing NUL byte, and back up 'a' to the last character. */
-	*a-- = '\0';
+/*
+ * pg_ltostr_zeropad: write a signed 32-bit integer, zero-padded
+ *
+ * Like sprintf's "%0*d": the result takes at least minwidth characters,
+ * counting the sign.  No NUL is added; returns a pointer just past the last
+ * character written.  Caller must ensure there's room for Max(minwidth, 11)
+ * characters.
+ */
+char *
+pg_ltostr_zeropad(char *str, int32 value, int32 minwidth)
+{
+	uint32		uvalue = (uint32) value;
+	int			len;
 
-	/* Reverse string. */
-	while (start < a)
+	if (value < 0)
 	{
-		char		swap = *start;
-
-		*start++ = *a;
-		*a-- = swap;
+		uvalue = (uint32) 0 - uvalue;
+		*str++ = '-';
+		minwidth--;
+	}
+	len = decimal_length32(uvalue);
+	while (len < minwidth)
+	{
+		*str++ = '0';
+		minwidth--;
 	}
+	return str + pg_ultoa_n(uvalue, str);
 }
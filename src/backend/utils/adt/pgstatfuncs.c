@@ -20,6 +20,8 @@
 #include "libpq/ip.h"
 #include "miscadmin.h"
 #include "pgstat.h"
+#include "storage/lwlock.h"
+#include "storage/procarray.h"
 #include "utils/acl.h"
 #include "utils/builtins.h"
 #include "utils/inet.h"
@@ -46,6 +48,8 @@ extern Datum pg_stat_get_vacuum_count(PG_FUNCTION_ARGS);
 extern Datum pg_stat_get_autovacuum_count(PG_FUNCTION_ARGS);
 extern Datum pg_stat_get_analyze_count(PG_FUNCTION_ARGS);
 extern Datum pg_stat_get_autoanalyze_count(PG_FUNCTION_ARGS);
+extern Datum pg_stat_get_ext_lock_waits(PG_FUNCTION_ARGS);
+extern Datum pg_stat_get_prunes_deferred(PG_FUNCTION_ARGS);
 
 extern Datum pg_stat_get_function_calls(PG_FUNCTION_ARGS);
 extern Datum pg_stat_get_function_total_time(PG_FUNCTION_ARGS);
@@ -53,6 +57,7 @@ extern Datum pg_stat_get_function_self_time(PG_FUNCTION_ARGS);
 
 extern Datum pg_stat_get_backend_idset(PG_FUNCTION_ARGS);
 extern Datum pg_stat_get_activity(PG_FUNCTION_ARGS);
+extern Datum pg_stat_get_lwlocks(PG_FUNCTION_ARGS);
 extern Datum pg_backend_pid(PG_FUNCTION_ARGS);
 extern Datum pg_stat_get_backend_pid(PG_FUNCTION_ARGS);
 extern Datum pg_stat_get_backend_dbid(PG_FUNCTION_ARGS);
@@ -449,6 +454,36 @@ pg_stat_get_autoanalyze_count(PG_FUNCTION_ARGS)
 	PG_RETURN_INT64(result);
 }
 
+Datum
+pg_stat_get_ext_lock_waits(PG_FUNCTION_ARGS)
+{
+	Oid			relid = PG_GETARG_OID(0);
+	int64		result;
+	PgStat_StatTabEntry *tabentry;
+
+	if ((tabentry = pgstat_fetch_stat_tabentry(relid)) == NULL)
+		result = 0;
+	else
+		result = (int64) (tabentry->ext_lock_waits);
+
+	PG_RETURN_INT64(result);
+}
+
+Datum
+pg_stat_get_prunes_deferred(PG_FUNCTION_ARGS)
+{
+	Oid			relid = PG_GETARG_OID(0);
+	int64		result;
+	PgStat_StatTabEntry *tabentry;
+
+	if ((tabentry = pgstat_fetch_stat_tabentry(relid)) == NULL)
+		result = 0;
+	else
+		result = (int64) (tabentry->prunes_deferred);
+
+	PG_RETURN_INT64(result);
+}
+
 Datum
 pg_stat_get_function_calls(PG_FUNCTION_ARGS)
 {
@@ -530,7 +565,7 @@ pg_stat_get_backend_idset(PG_FUNCTION_ARGS)
 Datum
 pg_stat_get_activity(PG_FUNCTION_ARGS)
 {
-#define PG_STAT_GET_ACTIVITY_COLS	22
+#define PG_STAT_GET_ACTIVITY_COLS	24
 	int			num_backends = pgstat_fetch_stat_numbackends();
 	int			curr_backend;
 	int			pid = PG_ARGISNULL(0) ? -1 : PG_GETARG_INT32(0);
@@ -645,6 +680,8 @@ pg_stat_get_activity(PG_FUNCTION_ARGS)
 		if (has_privs_of_role(GetUserId(), beentry->st_userid))
 		{
 			SockAddr	zero_clientaddr;
+			PGPROC	   *proc;
+			uint32		wait_event_info = 0;
 
 			switch (beentry->st_state)
 			{
@@ -674,6 +711,25 @@ pg_stat_get_activity(PG_FUNCTION_ARGS)
 			values[5] = CStringGetTextDatum(beentry->st_activity);
 			values[6] = BoolGetDatum(beentry->st_waiting);
 
+			/*
+			 * The wait event lives in the PGPROC rather than the backend
+			 * status entry, so that setting it is just a store.  Read it
+			 * without a lock; a torn or stale value is harmless here.
+			 */
+			proc = BackendPidGetProc(beentry->st_procpid);
+			if (proc != NULL)
+				wait_event_info = proc->wait_event_info;
+			if (wait_event_info != 0)
+			{
+				values[22] = CStringGetTextDatum(pgstat_get_wait_event_type(wait_event_info));
+				values[23] = CStringGetTextDatum(pgstat_get_wait_event(wait_event_info));
+			}
+			else
+			{
+				nulls[22] = true;
+				nulls[23] = true;
+			}
+
 			if (beentry->st_xact_start_timestamp != 0)
 				values[7] = TimestampTzGetDatum(beentry->st_xact_start_timestamp);
 			else
@@ -775,6 +831,8 @@ pg_stat_get_activity(PG_FUNCTION_ARGS)
 			nulls[11] = true;
 			nulls[12] = true;
 			nulls[13] = true;
+			nulls[22] = true;
+			nulls[23] = true;
 		}
 
 		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
@@ -790,6 +848,78 @@ pg_stat_get_activity(PG_FUNCTION_ARGS)
 	return (Datum) 0;
 }
 
+/*
+ * Returns cumulative contention statistics of LWLocks.
+ */
+Datum
+pg_stat_get_lwlocks(PG_FUNCTION_ARGS)
+{
+#define PG_STAT_GET_LWLOCKS_COLS	7
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	LWLockStatsData *stats;
+	int			nstats;
+	int			i;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	stats = GetLWLockStatsData(&nstats);
+
+	for (i = 0; i < nstats; i++)
+	{
+		LWLockStatsData *entry = &stats[i];
+		Datum		values[PG_STAT_GET_LWLOCKS_COLS];
+		bool		nulls[PG_STAT_GET_LWLOCKS_COLS];
+
+		MemSet(nulls, 0, sizeof(nulls));
+
+		values[0] = CStringGetTextDatum(entry->name);
+		if (entry->partition >= 0)
+			values[1] = Int32GetDatum(entry->partition);
+		else
+			nulls[1] = true;
+		values[2] = Int64GetDatum((int64) entry->counters.sh_acquire_count);
+		values[3] = Int64GetDatum((int64) entry->counters.ex_acquire_count);
+		values[4] = Int64GetDatum((int64) entry->counters.block_count);
+		/* convert counter from microsec to millisec for display */
+		values[5] = Float8GetDatum(((double) entry->counters.wait_time) / 1000.0);
+		values[6] = Int64GetDatum((int64) entry->counters.spin_delay_count);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+
 
 Datum
 pg_backend_pid(PG_FUNCTION_ARGS)
@@ -19,6 +19,7 @@
 #include "utils/builtins.h"
 #include "utils/datum.h"
 #include "utils/rangetypes.h"
+#include "utils/sortsupport.h"
 
 
 /*
@@ -241,6 +242,74 @@ range_gist_fetch(PG_FUNCTION_ARGS)
 	PG_RETURN_POINTER(entry);
 }
 
+/*
+ * Sort comparator for the sorted index build: the same ordering as
+ * range_cmp, i.e. empty ranges first, then by lower and upper bound.
+ * Ordering by lower bound keeps ranges that start close together on the same
+ * leaf page, which is what the bottom-up build needs.
+ */
+static int
+range_gist_cmp(Datum a, Datum b, SortSupport ssup)
+{
+	RangeType  *range_a = DatumGetRangeType(a);
+	RangeType  *range_b = DatumGetRangeType(b);
+	TypeCacheEntry *typcache = (TypeCacheEntry *) ssup->ssup_extra;
+	RangeBound	lower1,
+				lower2;
+	RangeBound	upper1,
+				upper2;
+	bool		empty1,
+				empty2;
+	int			cmp;
+
+	if (typcache == NULL || typcache->type_id != RangeTypeGetOid(range_a))
+	{
+		typcache = lookup_type_cache(RangeTypeGetOid(range_a),
+									 TYPECACHE_RANGE_INFO);
+		if (typcache->rngelemtype == NULL)
+			elog(ERROR, "type %u is not a range type",
+				 RangeTypeGetOid(range_a));
+		ssup->ssup_extra = typcache;
+	}
+
+	range_deserialize(typcache, range_a, &lower1, &upper1, &empty1);
+	range_deserialize(typcache, range_b, &lower2, &upper2, &empty2);
+
+	if (empty1 && empty2)
+		cmp = 0;
+	else if (empty1)
+		cmp = -1;
+	else if (empty2)
+		cmp = 1;
+	else
+	{
+		cmp = range_cmp_bounds(typcache, &lower1, &lower2);
+		if (cmp == 0)
+			cmp = range_cmp_bounds(typcache, &upper1, &upper2);
+	}
+
+	if ((Pointer) range_a != DatumGetPointer(a))
+		pfree(range_a);
+	if ((Pointer) range_b != DatumGetPointer(b))
+		pfree(range_b);
+
+	return cmp;
+}
+
+/*
+ * GiST sortsupport method for ranges, used by the sorted index build
+ */
+Datum
+range_gist_sortsupport(PG_FUNCTION_ARGS)
+{
+	SortSupport ssup = (SortSupport) PG_GETARG_POINTER(0);
+
+	ssup->comparator = range_gist_cmp;
+	ssup->ssup_extra = NULL;
+
+	PG_RETURN_VOID();
+}
+
 /*
  * GiST page split penalty function.
  *
@@ -99,6 +99,9 @@ typedef struct cached_re_str
 	int			cre_flags;		/* compile flags: extended,icase etc */
 	Oid			cre_collation;	/* collation to use */
 	regex_t		cre_re;			/* the compiled regular expression */
+	int			cre_lit_off;	/* offset in cre_pat of a literal that every
+								 * match contains ... */
+	int			cre_lit_len;	/* ... and its length, or 0 if none known */
 } cached_re_str;
 
 static int	num_res = 0;		/* # of cached re's */
@@ -106,6 +109,10 @@ static cached_re_str re_array[MAX_CACHED_RES];	/* cached re's */
 
 
 /* Local functions */
+static void RE_find_required_literal(const char *pat, int pat_len, int cflags,
+						 int *lit_off, int *lit_len);
+static bool RE_data_contains(const char *dat, int dat_len,
+				 const char *lit, int lit_len);
 static regexp_matches_ctx *setup_regexp_matches(text *orig_str, text *pattern,
 					 text *flags,
 					 Oid collation,
@@ -222,6 +229,8 @@ RE_compile_and_cache(text *text_re, int cflags, Oid collation)
 	re_temp.cre_pat_len = text_re_len;
 	re_temp.cre_flags = cflags;
 	re_temp.cre_collation = collation;
+	RE_find_required_literal(re_temp.cre_pat, text_re_len, cflags,
+							 &re_temp.cre_lit_off, &re_temp.cre_lit_len);
 
 	/*
 	 * Okay, we have a valid new item in re_temp; insert it into the storage
@@ -244,6 +253,194 @@ RE_compile_and_cache(text *text_re, int cflags, Oid collation)
 	return &re_array[0].cre_re;
 }
 
+/*
+ * RE_find_required_literal - find a string that every match of a RE contains
+ *
+ * Only the simplest case is recognized: runs of ordinary characters at the
+ * top nesting level of an ARE that has no top-level alternation.  Every such
+ * character is required, and consecutive ones must match consecutively, so
+ * the run's bytes must appear in any string the RE matches.  We pick the
+ * longest run, and set *lit_off and *lit_len to its place in the pattern;
+ * *lit_len is set to 0 if there is none.
+ *
+ * Anything we don't understand just ends the current run, which is always
+ * safe.  Case-insensitive, expanded-syntax and non-ARE patterns, and ones
+ * starting with a director or embedded options, are not analyzed at all.
+ */
+static void
+RE_find_required_literal(const char *pat, int pat_len, int cflags,
+						 int *lit_off, int *lit_len)
+{
+	int			depth = 0;
+	int			run_off = 0;
+	int			run_len = 0;
+	int			last_off = 0;	/* start of the last character in the run */
+	int			i = 0;
+
+	*lit_off = 0;
+	*lit_len = 0;
+
+	if ((cflags & (REG_ADVANCED | REG_QUOTE | REG_ICASE | REG_EXPANDED)) !=
+		REG_ADVANCED)
+		return;
+	if ((pat_len >= 3 && memcmp(pat, "***", 3) == 0) ||
+		(pat_len >= 2 && memcmp(pat, "(?", 2) == 0))
+		return;
+
+#define END_RUN() \
+	do { \
+		if (run_len > *lit_len) \
+		{ \
+			*lit_off = run_off; \
+			*lit_len = run_len; \
+		} \
+		run_len = 0; \
+	} while (0)
+
+	while (i < pat_len)
+	{
+		char		c = pat[i];
+
+		switch (c)
+		{
+			case '|':
+				if (depth == 0)
+				{
+					/* top-level alternation: nothing is required */
+					*lit_len = 0;
+					return;
+				}
+				i++;
+				break;
+
+			case '(':
+				END_RUN();
+				depth++;
+				i++;
+				break;
+
+			case ')':
+				END_RUN();
+				depth--;
+				i++;
+				break;
+
+			case '\\':
+				END_RUN();
+				i++;
+				if (i < pat_len && isalnum((unsigned char) pat[i]))
+				{
+					/*
+					 * A class or numeric escape, such as \d or \x41, which
+					 * may consume any letters and digits that follow it; \cX
+					 * consumes one more character of any kind.
+					 */
+					if (pat[i] == 'c')
+						i++;
+					while (i < pat_len && isalnum((unsigned char) pat[i]))
+						i++;
+				}
+				else if (i < pat_len)
+					i += pg_mblen(pat + i);
+				break;
+
+			case '[':
+				END_RUN();
+				/* skip the bracket expression */
+				i++;
+				if (i < pat_len && pat[i] == '^')
+					i++;
+				if (i < pat_len && pat[i] == ']')
+					i++;
+				while (i < pat_len && pat[i] != ']')
+				{
+					if (pat[i] == '[' && i + 1 < pat_len &&
+						(pat[i + 1] == ':' || pat[i + 1] == '.' ||
+						 pat[i + 1] == '='))
+					{
+						char		delim = pat[i + 1];
+
+						i += 2;
+						while (i + 1 < pat_len &&
+							   !(pat[i] == delim && pat[i + 1] == ']'))
+							i++;
+						i += 2;
+					}
+					else if (pat[i] == '\\')
+						i += 2;
+					else
+						i++;
+				}
+				i++;
+				break;
+
+			case '*':
+			case '?':
+			case '{':
+				/* the preceding atom is optional, so it's not required */
+				if (depth == 0 && run_len > 0)
+					run_len = last_off - run_off;
+				END_RUN();
+				if (c == '{')
+				{
+					while (i < pat_len && pat[i] != '}')
+						i++;
+				}
+				i++;
+				break;
+
+			case '+':
+			case '.':
+			case '^':
+			case '$':
+			case ']':
+			case '}':
+				END_RUN();
+				i++;
+				break;
+
+			default:
+				if (depth == 0)
+				{
+					if (run_len == 0)
+						run_off = i;
+					last_off = i;
+					run_len = i - run_off + pg_mblen(pat + i);
+				}
+				i += pg_mblen(pat + i);
+				break;
+		}
+	}
+	END_RUN();
+
+#undef END_RUN
+
+	/* Don't trust the result if the pattern confused us */
+	if (depth != 0 || *lit_off + *lit_len > pat_len)
+		*lit_len = 0;
+}
+
+/*
+ * RE_data_contains - does dat contain the byte string lit?
+ */
+static bool
+RE_data_contains(const char *dat, int dat_len, const char *lit, int lit_len)
+{
+	const char *p = dat;
+	const char *last = dat + dat_len - lit_len;
+
+	while (p <= last)
+	{
+		p = memchr(p, lit[0], last - p + 1);
+		if (p == NULL)
+			return false;
+		if (memcmp(p + 1, lit + 1, lit_len - 1) == 0)
+			return true;
+		p++;
+	}
+	return false;
+}
+
 /*
  * RE_wchar_execute - execute a RE on pg_wchar data
  *
@@ -345,6 +542,17 @@ RE_compile_and_execute(text *text_re, char *dat, int dat_len,
 	/* Compile RE */
 	re = RE_compile_and_cache(text_re, cflags, collation);
 
+	/*
+	 * If there's a literal that every match must contain, and the data
+	 * doesn't, we needn't convert the data and run the matcher at all.  The
+	 * entry just used is always at the front of the cache.
+	 */
+	if (re_array[0].cre_lit_len > 0 &&
+		!RE_data_contains(dat, dat_len,
+						  re_array[0].cre_pat + re_array[0].cre_lit_off,
+						  re_array[0].cre_lit_len))
+		return false;
+
 	return RE_execute(re, dat, dat_len, nmatch, pmatch);
 }
 
@@ -12,6 +12,10 @@
  *	There is not currently any provision for throwing away a no-longer-needed
  *	plan --- consider improving this someday.
  *
+ *	The rows queued up by RI_FKey_check to have their keys checked together
+ *	are kept in a child context of TopTransactionContext, and never outlive
+ *	the trigger event list that they came from; see RI_FKey_flush_checks.
+ *
  *
  * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
  *
@@ -44,6 +48,7 @@
 #include "parser/parse_relation.h"
 #include "miscadmin.h"
 #include "utils/acl.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/fmgroids.h"
 #include "utils/guc.h"
@@ -75,16 +80,21 @@
 /* these queries are executed against the PK (referenced) table: */
 #define RI_PLAN_CHECK_LOOKUPPK			1
 #define RI_PLAN_CHECK_LOOKUPPK_FROM_PK	2
-#define RI_PLAN_LAST_ON_PK				RI_PLAN_CHECK_LOOKUPPK_FROM_PK
+#define RI_PLAN_CHECK_LOOKUPPK_BATCH	3
+#define RI_PLAN_LAST_ON_PK				RI_PLAN_CHECK_LOOKUPPK_BATCH
 /* these queries are executed against the FK (referencing) table: */
-#define RI_PLAN_CASCADE_DEL_DODELETE	3
-#define RI_PLAN_CASCADE_UPD_DOUPDATE	4
-#define RI_PLAN_RESTRICT_DEL_CHECKREF	5
-#define RI_PLAN_RESTRICT_UPD_CHECKREF	6
-#define RI_PLAN_SETNULL_DEL_DOUPDATE	7
-#define RI_PLAN_SETNULL_UPD_DOUPDATE	8
-#define RI_PLAN_SETDEFAULT_DEL_DOUPDATE 9
-#define RI_PLAN_SETDEFAULT_UPD_DOUPDATE 10
+#define RI_PLAN_CASCADE_DEL_DODELETE	4
+#define RI_PLAN_CASCADE_UPD_DOUPDATE	5
+#define RI_PLAN_RESTRICT_DEL_CHECKREF	6
+#define RI_PLAN_RESTRICT_UPD_CHECKREF	7
+#define RI_PLAN_SETNULL_DEL_DOUPDATE	8
+#define RI_PLAN_SETNULL_UPD_DOUPDATE	9
+#define RI_PLAN_SETDEFAULT_DEL_DOUPDATE 10
+#define RI_PLAN_SETDEFAULT_UPD_DOUPDATE 11
+
+/* limits on the rows queued up by RI_FKey_check, see ri_QueueCheck */
+#define RI_CHECK_BATCH_SIZE				64
+#define RI_MAX_CHECK_BATCHES			8
 
 #define MAX_QUOTED_NAME_LEN  (NAMEDATALEN*2+3)
 #define MAX_QUOTED_REL_NAME_LEN  (MAX_QUOTED_NAME_LEN*2)
@@ -178,6 +188,22 @@ typedef struct RI_CompareHashEntry
 } RI_CompareHashEntry;
 
 
+/* ----------
+ * RI_CheckBatch
+ *
+ *	New FK rows whose keys are waiting to be checked together
+ * ----------
+ */
+typedef struct RI_CheckBatch
+{
+	Oid			constraint_id;	/* OID of pg_constraint entry */
+	int			nrows;			/* number of rows queued */
+	int			nkeys;			/* number of distinct keys among them */
+	HeapTuple	rows[RI_CHECK_BATCH_SIZE];		/* copies of the rows */
+	Datum		keys[RI_CHECK_BATCH_SIZE];		/* the distinct keys */
+} RI_CheckBatch;
+
+
 /* ----------
  * Local data
  * ----------
@@ -186,6 +212,11 @@ static HTAB *ri_constraint_cache = NULL;
 static HTAB *ri_query_cache = NULL;
 static HTAB *ri_compare_cache = NULL;
 
+static MemoryContext ri_check_cxt = NULL;
+static RI_CheckBatch *ri_check_batches[RI_MAX_CHECK_BATCHES];
+static int	ri_num_check_batches = 0;
+static int	ri_check_nestlevel = 0;		/* xact nest level they belong to */
+
 
 /* ----------
  * Local function prototypes
@@ -241,6 +272,19 @@ static void ri_ReportViolation(const RI_ConstraintInfo *riinfo,
 				   Relation pk_rel, Relation fk_rel,
 				   HeapTuple violator, TupleDesc tupdesc,
 				   int queryno, bool spi_err);
+static SPIPlanPtr ri_PlanLookupPK(const RI_ConstraintInfo *riinfo,
+				Relation fk_rel, Relation pk_rel,
+				RI_QueryKey *qkey);
+static SPIPlanPtr ri_PlanLookupPKBatch(const RI_ConstraintInfo *riinfo,
+					 Relation fk_rel, Relation pk_rel,
+					 RI_QueryKey *qkey);
+static void ri_QueueCheck(const RI_ConstraintInfo *riinfo,
+			  Relation fk_rel, HeapTuple new_row);
+static void ri_CheckBatch(RI_CheckBatch *batch);
+static bool ri_PerformBatchCheck(const RI_ConstraintInfo *riinfo,
+					 SPIPlanPtr qplan,
+					 Relation fk_rel, Relation pk_rel,
+					 RI_CheckBatch *batch);
 
 
 /* ----------
@@ -259,7 +303,6 @@ RI_FKey_check(TriggerData *trigdata)
 	Buffer		new_row_buf;
 	RI_QueryKey qkey;
 	SPIPlanPtr	qplan;
-	int			i;
 
 	/*
 	 * Get arguments.
@@ -385,56 +428,25 @@ RI_FKey_check(TriggerData *trigdata)
 			break;
 	}
 
+	/*
+	 * A single-column key need not be checked right away: queue it up to be
+	 * looked up together with those of the other rows, which costs one
+	 * query per batch instead of one per row.
+	 */
+	if (riinfo->nkeys == 1)
+	{
+		ri_QueueCheck(riinfo, fk_rel, new_row);
+		heap_close(pk_rel, RowShareLock);
+		return PointerGetDatum(NULL);
+	}
+
 	if (SPI_connect() != SPI_OK_CONNECT)
 		elog(ERROR, "SPI_connect failed");
 
 	/*
 	 * Fetch or prepare a saved plan for the real check
 	 */
-	ri_BuildQueryKey(&qkey, riinfo, RI_PLAN_CHECK_LOOKUPPK);
-
-	if ((qplan = ri_FetchPreparedPlan(&qkey)) == NULL)
-	{
-		StringInfoData querybuf;
-		char		pkrelname[MAX_QUOTED_REL_NAME_LEN];
-		char		attname[MAX_QUOTED_NAME_LEN];
-		char		paramname[16];
-		const char *querysep;
-		Oid			queryoids[RI_MAX_NUMKEYS];
-
-		/* ----------
-		 * The query string built is
-		 *	SELECT 1 FROM ONLY <pktable> x WHERE pkatt1 = $1 [AND ...]
-		 *		   FOR KEY SHARE OF x
-		 * The type id's for the $ parameters are those of the
-		 * corresponding FK attributes.
-		 * ----------
-		 */
-		initStringInfo(&querybuf);
-		quoteRelationName(pkrelname, pk_rel);
-		appendStringInfo(&querybuf, "SELECT 1 FROM ONLY %s x", pkrelname);
-		querysep = "WHERE";
-		for (i = 0; i < riinfo->nkeys; i++)
-		{
-			Oid			pk_type = RIAttType(pk_rel, riinfo->pk_attnums[i]);
-			Oid			fk_type = RIAttType(fk_rel, riinfo->fk_attnums[i]);
-
-			quoteOneName(attname,
-						 RIAttName(pk_rel, riinfo->pk_attnums[i]));
-			sprintf(paramname, "$%d", i + 1);
-			ri_GenerateQual(&querybuf, querysep,
-							attname, pk_type,
-							riinfo->pf_eq_oprs[i],
-							paramname, fk_type);
-			querysep = "AND";
-			queryoids[i] = fk_type;
-		}
-		appendStringInfoString(&querybuf, " FOR KEY SHARE OF x");
-
-		/* Prepare and save the plan */
-		qplan = ri_PlanCheck(querybuf.data, riinfo->nkeys, queryoids,
-							 &qkey, fk_rel, pk_rel, true);
-	}
+	qplan = ri_PlanLookupPK(riinfo, fk_rel, pk_rel, &qkey);
 
 	/*
 	 * Now check that foreign key exists in PK table
@@ -454,6 +466,380 @@ RI_FKey_check(TriggerData *trigdata)
 }
 
 
+/* ----------
+ * ri_PlanLookupPK -
+ *
+ *	Fetch or prepare the saved plan used by RI_FKey_check to look up the
+ *	PK row matching the key of a new FK row.
+ * ----------
+ */
+static SPIPlanPtr
+ri_PlanLookupPK(const RI_ConstraintInfo *riinfo,
+				Relation fk_rel, Relation pk_rel,
+				RI_QueryKey *qkey)
+{
+	SPIPlanPtr	qplan;
+	StringInfoData querybuf;
+	char		pkrelname[MAX_QUOTED_REL_NAME_LEN];
+	char		attname[MAX_QUOTED_NAME_LEN];
+	char		paramname[16];
+	const char *querysep;
+	Oid			queryoids[RI_MAX_NUMKEYS];
+	int			i;
+
+	ri_BuildQueryKey(qkey, riinfo, RI_PLAN_CHECK_LOOKUPPK);
+
+	if ((qplan = ri_FetchPreparedPlan(qkey)) != NULL)
+		return qplan;
+
+	/* ----------
+	 * The query string built is
+	 *	SELECT 1 FROM ONLY <pktable> x WHERE pkatt1 = $1 [AND ...]
+	 *		   FOR KEY SHARE OF x
+	 * The type id's for the $ parameters are those of the
+	 * corresponding FK attributes.
+	 * ----------
+	 */
+	initStringInfo(&querybuf);
+	quoteRelationName(pkrelname, pk_rel);
+	appendStringInfo(&querybuf, "SELECT 1 FROM ONLY %s x", pkrelname);
+	querysep = "WHERE";
+	for (i = 0; i < riinfo->nkeys; i++)
+	{
+		Oid			pk_type = RIAttType(pk_rel, riinfo->pk_attnums[i]);
+		Oid			fk_type = RIAttType(fk_rel, riinfo->fk_attnums[i]);
+
+		quoteOneName(attname,
+					 RIAttName(pk_rel, riinfo->pk_attnums[i]));
+		sprintf(paramname, "$%d", i + 1);
+		ri_GenerateQual(&querybuf, querysep,
+						attname, pk_type,
+						riinfo->pf_eq_oprs[i],
+						paramname, fk_type);
+		querysep = "AND";
+		queryoids[i] = fk_type;
+	}
+	appendStringInfoString(&querybuf, " FOR KEY SHARE OF x");
+
+	/* Prepare and save the plan */
+	return ri_PlanCheck(querybuf.data, riinfo->nkeys, queryoids,
+						qkey, fk_rel, pk_rel, true);
+}
+
+
+/* ----------
+ * ri_PlanLookupPKBatch -
+ *
+ *	Fetch or prepare the saved plan used by ri_CheckBatch to look up the
+ *	PK rows matching an array of single-column FK keys.  Returns NULL if
+ *	the datatypes involved have no array types.
+ * ----------
+ */
+static SPIPlanPtr
+ri_PlanLookupPKBatch(const RI_ConstraintInfo *riinfo,
+					 Relation fk_rel, Relation pk_rel,
+					 RI_QueryKey *qkey)
+{
+	SPIPlanPtr	qplan;
+	StringInfoData querybuf;
+	char		pkrelname[MAX_QUOTED_REL_NAME_LEN];
+	char		attname[MAX_QUOTED_NAME_LEN];
+	Oid			pk_type = RIAttType(pk_rel, riinfo->pk_attnums[0]);
+	Oid			fk_type = RIAttType(fk_rel, riinfo->fk_attnums[0]);
+	Oid			fk_array_type;
+	Oid			cast_array_type = InvalidOid;
+	HeapTuple	opertup;
+	Form_pg_operator operform;
+
+	Assert(riinfo->nkeys == 1);
+
+	ri_BuildQueryKey(qkey, riinfo, RI_PLAN_CHECK_LOOKUPPK_BATCH);
+
+	if ((qplan = ri_FetchPreparedPlan(qkey)) != NULL)
+		return qplan;
+
+	opertup = SearchSysCache1(OPEROID,
+							  ObjectIdGetDatum(riinfo->pf_eq_oprs[0]));
+	if (!HeapTupleIsValid(opertup))
+		elog(ERROR, "cache lookup failed for operator %u",
+			 riinfo->pf_eq_oprs[0]);
+	operform = (Form_pg_operator) GETSTRUCT(opertup);
+
+	fk_array_type = get_array_type(fk_type);
+	if (fk_type != operform->oprright)
+		cast_array_type = get_array_type(operform->oprright);
+	if (!OidIsValid(fk_array_type) ||
+		(fk_type != operform->oprright && !OidIsValid(cast_array_type)))
+	{
+		ReleaseSysCache(opertup);
+		return NULL;
+	}
+
+	/* ----------
+	 * The query string built is
+	 *	SELECT 1 FROM ONLY <pktable> x WHERE pkatt1 = ANY ($1)
+	 *		   FOR KEY SHARE OF x
+	 * The type id for the $1 parameter is the array type of the FK
+	 * attribute.  As in ri_GenerateQual, we spell out the operator and
+	 * casts to the operator's input types.
+	 * ----------
+	 */
+	initStringInfo(&querybuf);
+	quoteRelationName(pkrelname, pk_rel);
+	quoteOneName(attname, RIAttName(pk_rel, riinfo->pk_attnums[0]));
+	appendStringInfo(&querybuf, "SELECT 1 FROM ONLY %s x WHERE %s",
+					 pkrelname, attname);
+	if (pk_type != operform->oprleft)
+		ri_add_cast_to(&querybuf, operform->oprleft);
+	appendStringInfo(&querybuf, " OPERATOR(%s.",
+			 quote_identifier(get_namespace_name(operform->oprnamespace)));
+	appendStringInfoString(&querybuf, NameStr(operform->oprname));
+	appendStringInfoString(&querybuf, ") ANY ($1");
+	if (OidIsValid(cast_array_type))
+		ri_add_cast_to(&querybuf, cast_array_type);
+	appendStringInfoString(&querybuf, ") FOR KEY SHARE OF x");
+
+	ReleaseSysCache(opertup);
+
+	/* Prepare and save the plan */
+	return ri_PlanCheck(querybuf.data, 1, &fk_array_type,
+						qkey, fk_rel, pk_rel, true);
+}
+
+
+/* ----------
+ * ri_QueueCheck -
+ *
+ *	Queue up a new FK row, whose single-column key is known not to be null,
+ *	to have its key checked later by RI_FKey_flush_checks.
+ *
+ *	There is one batch of rows per constraint, and up to RI_MAX_CHECK_BATCHES
+ *	of them, so that the checks of several constraints on the same table can
+ *	be batched even though their trigger events are interleaved.  All the
+ *	batches are flushed when any of them fills up, or another is needed.
+ * ----------
+ */
+static void
+ri_QueueCheck(const RI_ConstraintInfo *riinfo,
+			  Relation fk_rel, HeapTuple new_row)
+{
+	RI_CheckBatch *batch = NULL;
+	MemoryContext oldcxt;
+	HeapTuple	row;
+	Datum		key;
+	bool		isnull;
+	Oid			fk_type;
+	int			i;
+
+	for (i = 0; i < ri_num_check_batches; i++)
+	{
+		if (ri_check_batches[i]->constraint_id == riinfo->constraint_id)
+		{
+			batch = ri_check_batches[i];
+			break;
+		}
+	}
+
+	if (batch == NULL)
+	{
+		if (ri_num_check_batches >= RI_MAX_CHECK_BATCHES)
+			RI_FKey_flush_checks();
+
+		if (ri_check_cxt == NULL)
+			ri_check_cxt = AllocSetContextCreate(TopTransactionContext,
+												 "RI check batches",
+												 ALLOCSET_DEFAULT_MINSIZE,
+												 ALLOCSET_DEFAULT_INITSIZE,
+												 ALLOCSET_DEFAULT_MAXSIZE);
+
+		batch = (RI_CheckBatch *) MemoryContextAlloc(ri_check_cxt,
+													 sizeof(RI_CheckBatch));
+		batch->constraint_id = riinfo->constraint_id;
+		batch->nrows = 0;
+		batch->nkeys = 0;
+		if (ri_num_check_batches == 0)
+			ri_check_nestlevel = GetCurrentTransactionNestLevel();
+		ri_check_batches[ri_num_check_batches++] = batch;
+	}
+
+	oldcxt = MemoryContextSwitchTo(ri_check_cxt);
+	row = heap_copytuple(new_row);
+	MemoryContextSwitchTo(oldcxt);
+
+	batch->rows[batch->nrows++] = row;
+
+	/* Remember the key, unless an earlier row has the same one */
+	key = heap_getattr(row, riinfo->fk_attnums[0],
+					   RelationGetDescr(fk_rel), &isnull);
+	Assert(!isnull);
+	fk_type = RIAttType(fk_rel, riinfo->fk_attnums[0]);
+	for (i = 0; i < batch->nkeys; i++)
+	{
+		if (ri_AttributesEqual(riinfo->ff_eq_oprs[0], fk_type,
+							   batch->keys[i], key))
+			break;
+	}
+	if (i == batch->nkeys)
+		batch->keys[batch->nkeys++] = key;
+
+	if (batch->nrows >= RI_CHECK_BATCH_SIZE)
+		RI_FKey_flush_checks();
+}
+
+
+/* ----------
+ * RI_FKey_flush_checks -
+ *
+ *	Check the keys of all the FK rows queued up by RI_FKey_check.
+ *
+ *	The trigger manager calls this after firing a set of trigger events, and
+ *	before firing any trigger other than an RI_FKey_check one, so the checks
+ *	happen before anything else could see or change the tables involved.
+ * ----------
+ */
+void
+RI_FKey_flush_checks(void)
+{
+	int			i;
+
+	for (i = 0; i < ri_num_check_batches; i++)
+		ri_CheckBatch(ri_check_batches[i]);
+
+	ri_num_check_batches = 0;
+	if (ri_check_cxt != NULL)
+		MemoryContextReset(ri_check_cxt);
+}
+
+
+/* ----------
+ * RI_FKey_discard_checks -
+ *
+ *	Forget the FK rows queued up by RI_FKey_check without checking them,
+ *	at (sub)transaction abort.
+ *
+ *	Rows queued up by an outer transaction level are kept, since the trigger
+ *	events they came from are still being fired.  (A subtransaction might be
+ *	started and aborted by the equality function we call in ri_QueueCheck.)
+ * ----------
+ */
+void
+RI_FKey_discard_checks(void)
+{
+	if (ri_num_check_batches > 0 &&
+		ri_check_nestlevel < GetCurrentTransactionNestLevel())
+		return;
+
+	ri_num_check_batches = 0;
+	if (ri_check_cxt != NULL)
+	{
+		MemoryContextDelete(ri_check_cxt);
+		ri_check_cxt = NULL;
+	}
+}
+
+
+/* ----------
+ * ri_CheckBatch -
+ *
+ *	Check that the keys of a batch of FK rows all exist in the PK table.
+ *
+ *	All the distinct keys are looked up with one query.  If any is missing,
+ *	or the batch query can't be used, we go through the rows one at a time,
+ *	as RI_FKey_check would have, to find and report the first offender.
+ * ----------
+ */
+static void
+ri_CheckBatch(RI_CheckBatch *batch)
+{
+	const RI_ConstraintInfo *riinfo;
+	Relation	fk_rel;
+	Relation	pk_rel;
+	RI_QueryKey qkey;
+	SPIPlanPtr	qplan;
+	int			i;
+
+	riinfo = ri_LoadConstraintInfo(batch->constraint_id);
+
+	/* the FK table is locked already, since we inserted or updated rows */
+	fk_rel = heap_open(riinfo->fk_relid, NoLock);
+	pk_rel = heap_open(riinfo->pk_relid, RowShareLock);
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "SPI_connect failed");
+
+	qplan = ri_PlanLookupPKBatch(riinfo, fk_rel, pk_rel, &qkey);
+
+	if (qplan == NULL ||
+		!ri_PerformBatchCheck(riinfo, qplan, fk_rel, pk_rel, batch))
+	{
+		qplan = ri_PlanLookupPK(riinfo, fk_rel, pk_rel, &qkey);
+
+		for (i = 0; i < batch->nrows; i++)
+			ri_PerformCheck(riinfo, &qkey, qplan,
+							fk_rel, pk_rel,
+							NULL, batch->rows[i],
+							false,
+							SPI_OK_SELECT);
+	}
+
+	if (SPI_finish() != SPI_OK_FINISH)
+		elog(ERROR, "SPI_finish failed");
+
+	heap_close(pk_rel, RowShareLock);
+	heap_close(fk_rel, NoLock);
+}
+
+
+/* ----------
+ * ri_PerformBatchCheck -
+ *
+ *	Run the query prepared by ri_PlanLookupPKBatch for the keys of a batch.
+ *	Returns true if a PK row was found for each of them.
+ * ----------
+ */
+static bool
+ri_PerformBatchCheck(const RI_ConstraintInfo *riinfo,
+					 SPIPlanPtr qplan,
+					 Relation fk_rel, Relation pk_rel,
+					 RI_CheckBatch *batch)
+{
+	Oid			fk_type = RIAttType(fk_rel, riinfo->fk_attnums[0]);
+	int16		typlen;
+	bool		typbyval;
+	char		typalign;
+	Datum		vals[1];
+	char		nulls[1];
+	int			spi_result;
+	Oid			save_userid;
+	int			save_sec_context;
+
+	get_typlenbyvalalign(fk_type, &typlen, &typbyval, &typalign);
+	vals[0] = PointerGetDatum(construct_array(batch->keys, batch->nkeys,
+											  fk_type,
+											  typlen, typbyval, typalign));
+	nulls[0] = ' ';
+
+	/* Switch to proper UID to perform check as */
+	GetUserIdAndSecContext(&save_userid, &save_sec_context);
+	SetUserIdAndSecContext(RelationGetForm(pk_rel)->relowner,
+						   save_sec_context | SECURITY_LOCAL_USERID_CHANGE);
+
+	spi_result = SPI_execute_snapshot(qplan,
+									  vals, nulls,
+									  InvalidSnapshot, InvalidSnapshot,
+									  false, false, 0);
+
+	/* Restore UID and security context */
+	SetUserIdAndSecContext(save_userid, save_sec_context);
+
+	if (spi_result != SPI_OK_SELECT)
+		elog(ERROR, "SPI_execute_snapshot returned %d", spi_result);
+
+	/* the PK is unique, so each distinct key can match only one row */
+	return SPI_processed >= batch->nkeys;
+}
+
+
 /* ----------
  * RI_FKey_check_ins -
  *
@@ -2992,6 +3378,7 @@ ri_PlanCheck(const char *querystr, int nargs, Oid *argtypes,
 	temp_sec_context = save_sec_context | SECURITY_LOCAL_USERID_CHANGE;
 	if (qkey->constr_queryno == RI_PLAN_CHECK_LOOKUPPK
 		|| qkey->constr_queryno == RI_PLAN_CHECK_LOOKUPPK_FROM_PK
+		|| qkey->constr_queryno == RI_PLAN_CHECK_LOOKUPPK_BATCH
 		|| qkey->constr_queryno == RI_PLAN_RESTRICT_DEL_CHECKREF
 		|| qkey->constr_queryno == RI_PLAN_RESTRICT_UPD_CHECKREF)
 		temp_sec_context |= SECURITY_ROW_LEVEL_DISABLED;
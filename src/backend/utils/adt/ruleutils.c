@@ -718,6 +718,8 @@ pg_get_triggerdef_worker(Oid trigid, bool pretty)
 	SysScanDesc tgscan;
 	int			findx = 0;
 	char	   *tgname;
+	char	   *tgoldtable;
+	char	   *tgnewtable;
 	Datum		value;
 	bool		isnull;
 
@@ -824,6 +826,23 @@ pg_get_triggerdef_worker(Oid trigid, bool pretty)
 			appendStringInfoString(&buf, "IMMEDIATE ");
 	}
 
+	value = fastgetattr(ht_trig, Anum_pg_trigger_tgoldtable,
+						tgrel->rd_att, &isnull);
+	tgoldtable = isnull ? NULL : NameStr(*DatumGetName(value));
+	value = fastgetattr(ht_trig, Anum_pg_trigger_tgnewtable,
+						tgrel->rd_att, &isnull);
+	tgnewtable = isnull ? NULL : NameStr(*DatumGetName(value));
+	if (tgoldtable != NULL || tgnewtable != NULL)
+	{
+		appendStringInfoString(&buf, "REFERENCING ");
+		if (tgoldtable != NULL)
+			appendStringInfo(&buf, "OLD TABLE AS %s ",
+							 quote_identifier(tgoldtable));
+		if (tgnewtable != NULL)
+			appendStringInfo(&buf, "NEW TABLE AS %s ",
+							 quote_identifier(tgnewtable));
+	}
+
 	if (TRIGGER_FOR_ROW(trigrec->tgtype))
 		appendStringInfoString(&buf, "FOR EACH ROW ");
 	else
@@ -1122,6 +1141,19 @@ pg_get_indexdef_worker(Oid indexrelid, int colno,
 		Oid			keycoltype;
 		Oid			keycolcollation;
 
+		/*
+		 * Non-key INCLUDE columns follow the key columns in a list of their
+		 * own.  A request for all columns with attrsOnly wants the keys only.
+		 */
+		if (keyno == idxrec->indnkeyatts)
+		{
+			if (attrsOnly && !colno)
+				break;
+			if (!colno)
+				appendStringInfoString(&buf, ") INCLUDE (");
+			sep = "";
+		}
+
 		if (!colno)
 			appendStringInfoString(&buf, sep);
 		sep = ", ";
@@ -1164,7 +1196,8 @@ pg_get_indexdef_worker(Oid indexrelid, int colno,
 			keycolcollation = exprCollation(indexkey);
 		}
 
-		if (!attrsOnly && (!colno || colno == keyno + 1))
+		if (!attrsOnly && keyno < idxrec->indnkeyatts &&
+			(!colno || colno == keyno + 1))
 		{
 			Oid			indcoll;
 
@@ -4170,6 +4203,25 @@ make_ruledef(StringInfo buf, HeapTuple ruletup, TupleDesc rulettc,
 }
 
 
+/*
+ * pg_get_querydef
+ *		Reconstruct the SQL text of a parsed SELECT query.
+ *
+ * Internal version that returns a palloc'd C string; no pretty-printing.
+ * The query is not modified.
+ */
+char *
+pg_get_querydef(Query *query)
+{
+	StringInfoData buf;
+
+	initStringInfo(&buf);
+	get_query_def((Query *) copyObject(query), &buf, NIL, NULL,
+				  0, WRAP_COLUMN_DEFAULT, 0);
+
+	return buf.data;
+}
+
 /* ----------
  * make_viewdef			- reconstruct the SELECT part of a
  *				  view rewrite rule
@@ -4447,7 +4499,19 @@ get_with_clause(Query *query, deparse_context *context)
 			}
 			appendStringInfoChar(buf, ')');
 		}
-		appendStringInfoString(buf, " AS (");
+		appendStringInfoString(buf, " AS ");
+		switch (cte->ctematerialized)
+		{
+			case CTEMaterializeDefault:
+				break;
+			case CTEMaterializeAlways:
+				appendStringInfoString(buf, "MATERIALIZED ");
+				break;
+			case CTEMaterializeNever:
+				appendStringInfoString(buf, "NOT MATERIALIZED ");
+				break;
+		}
+		appendStringInfoChar(buf, '(');
 		if (PRETTY_INDENT(context))
 			appendContextKeyword(context, "", 0, 0, 0);
 		get_query_def((Query *) cte->ctequery, buf, context->namespaces, NULL,
@@ -4456,6 +4520,23 @@ get_with_clause(Query *query, deparse_context *context)
 		if (PRETTY_INDENT(context))
 			appendContextKeyword(context, "", 0, 0, 0);
 		appendStringInfoChar(buf, ')');
+		if (cte->ctecyclecols)
+		{
+			bool		first = true;
+			ListCell   *col;
+
+			appendStringInfoString(buf, " CYCLE (");
+			foreach(col, cte->ctecyclecols)
+			{
+				if (first)
+					first = false;
+				else
+					appendStringInfoString(buf, ", ");
+				appendStringInfoString(buf,
+									   quote_identifier(strVal(lfirst(col))));
+			}
+			appendStringInfoChar(buf, ')');
+		}
 		sep = ", ";
 	}
 
@@ -3141,6 +3141,135 @@ add_unique_group_var(PlannerInfo *root, List *varinfos,
 	return varinfos;
 }
 
+/*
+ * get_index_group_stats
+ *		Fetch the statistics ANALYZE keeps about the group of table columns
+ *		that an index key starts with, up to and including index column
+ *		indexcol (counting from 1).
+ *
+ * Returns false if there are none.  Otherwise *ndistinct is set to the
+ * number of distinct combinations of values of the columns, in the
+ * stadistinct convention (negative means a multiple of the number of rows),
+ * and *degree to the degree to which the columns before the last determine
+ * the last one.  See STATISTIC_KIND_DEPENDENCY.
+ */
+bool
+get_index_group_stats(Oid indexoid, int indexcol,
+					  double *ndistinct, Selectivity *degree)
+{
+	HeapTuple	statsTuple;
+	float4	   *numbers;
+	int			nnumbers;
+	bool		result = false;
+
+	statsTuple = SearchSysCache3(STATRELATTINH,
+								 ObjectIdGetDatum(indexoid),
+								 Int16GetDatum(indexcol),
+								 BoolGetDatum(false));
+	if (!HeapTupleIsValid(statsTuple))
+		return false;
+
+	if (get_attstatsslot(statsTuple, InvalidOid, 0,
+						 STATISTIC_KIND_DEPENDENCY, InvalidOid,
+						 NULL,
+						 NULL, NULL,
+						 &numbers, &nnumbers))
+	{
+		if (nnumbers == 1)
+		{
+			*ndistinct = ((Form_pg_statistic) GETSTRUCT(statsTuple))->stadistinct;
+			*degree = numbers[0];
+			result = true;
+		}
+		free_attstatsslot(InvalidOid, NULL, 0, numbers, nnumbers);
+	}
+
+	ReleaseSysCache(statsTuple);
+
+	return result;
+}
+
+/*
+ * index_group_ndistinct
+ *		Look for the longest group of Vars in *relvarinfos, all of the same
+ *		rel, that some index key of the rel starts with, and for which we
+ *		have the number of distinct combinations of values.
+ *
+ * If there is one, returns that number and removes the Vars from
+ * *relvarinfos.  Returns 0 otherwise.
+ */
+static double
+index_group_ndistinct(RelOptInfo *rel, List **relvarinfos)
+{
+	GroupVarInfo *matches[INDEX_MAX_KEYS];
+	GroupVarInfo *bestmatches[INDEX_MAX_KEYS];
+	int			bestncols = 0;
+	double		bestndistinct = 0;
+	ListCell   *lc;
+	int			i;
+
+	if (list_length(*relvarinfos) < 2 || rel->tuples <= 0)
+		return 0;
+
+	foreach(lc, rel->indexlist)
+	{
+		IndexOptInfo *index = (IndexOptInfo *) lfirst(lc);
+		int			ncols;
+
+		if (index->indpred != NIL)
+			continue;
+
+		/* find how many of the leading index columns we group by */
+		for (ncols = 0; ncols < index->nkeycolumns; ncols++)
+		{
+			ListCell   *lc2;
+
+			matches[ncols] = NULL;
+			if (index->indexkeys[ncols] == 0)
+				break;
+			foreach(lc2, *relvarinfos)
+			{
+				GroupVarInfo *varinfo = (GroupVarInfo *) lfirst(lc2);
+				Var		   *var = (Var *) varinfo->var;
+
+				if (IsA(var, Var) &&
+					var->varno == rel->relid &&
+					var->varattno == index->indexkeys[ncols])
+				{
+					matches[ncols] = varinfo;
+					break;
+				}
+			}
+			if (matches[ncols] == NULL)
+				break;
+		}
+
+		/* use the longest prefix we have statistics for */
+		for (; ncols > bestncols && ncols >= 2; ncols--)
+		{
+			double		ndistinct;
+			Selectivity degree;
+
+			if (get_index_group_stats(index->indexoid, ncols,
+									  &ndistinct, &degree) &&
+				ndistinct != 0)
+			{
+				if (ndistinct < 0)
+					ndistinct = -ndistinct * rel->tuples;
+				bestncols = ncols;
+				bestndistinct = ndistinct;
+				memcpy(bestmatches, matches, ncols * sizeof(GroupVarInfo *));
+				break;
+			}
+		}
+	}
+
+	for (i = 0; i < bestncols; i++)
+		*relvarinfos = list_delete_ptr(*relvarinfos, bestmatches[i]);
+
+	return bestndistinct;
+}
+
 /*
  * estimate_num_groups		- Estimate number of groups in a grouped query
  *
@@ -3195,7 +3324,10 @@ add_unique_group_var(PlannerInfo *root, List *varinfos,
  *		the initial product is probably too high (it's the worst case) but
  *		clamping to a fraction of the rel's rows seems to be a helpful
  *		heuristic for not letting the estimate get out of hand.  (The factor
- *		of 10 is derived from pre-Postgres-7.4 practice.)  Multiplying
+ *		of 10 is derived from pre-Postgres-7.4 practice.)  If some of the Vars
+ *		are the leading columns of an index, though, ANALYZE has estimated
+ *		the number of distinct combinations of their values, and we use that
+ *		instead of the product of their numbers of values.  Multiplying
  *		by the restriction selectivity is effectively assuming that the
  *		restriction clauses are independent of the grouping, which is a crummy
  *		assumption, but it's hard to do better.
@@ -3334,26 +3466,22 @@ estimate_num_groups(PlannerInfo *root, List *groupExprs, double input_rows,
 	{
 		GroupVarInfo *varinfo1 = (GroupVarInfo *) linitial(varinfos);
 		RelOptInfo *rel = varinfo1->rel;
-		double		reldistinct = varinfo1->ndistinct;
-		double		relmaxndistinct = reldistinct;
-		int			relvarcount = 1;
+		double		reldistinct = 1.0;
+		double		relmaxndistinct = 0.0;
+		int			relvarcount = 0;
+		List	   *relvarinfos = list_make1(varinfo1);
 		List	   *newvarinfos = NIL;
 
 		/*
-		 * Get the product of numdistinct estimates of the Vars for this rel.
-		 * Also, construct new varinfos list of remaining Vars.
+		 * Collect the Vars for this rel.  Also, construct new varinfos list
+		 * of remaining Vars.
 		 */
 		for_each_cell(l, lnext(list_head(varinfos)))
 		{
 			GroupVarInfo *varinfo2 = (GroupVarInfo *) lfirst(l);
 
 			if (varinfo2->rel == varinfo1->rel)
-			{
-				reldistinct *= varinfo2->ndistinct;
-				if (relmaxndistinct < varinfo2->ndistinct)
-					relmaxndistinct = varinfo2->ndistinct;
-				relvarcount++;
-			}
+				relvarinfos = lappend(relvarinfos, varinfo2);
 			else
 			{
 				/* not time to process varinfo2 yet */
@@ -3361,6 +3489,32 @@ estimate_num_groups(PlannerInfo *root, List *groupExprs, double input_rows,
 			}
 		}
 
+		/*
+		 * If an index starts with some of the Vars, take the number of
+		 * distinct combinations of those from its statistics.
+		 */
+		reldistinct = index_group_ndistinct(rel, &relvarinfos);
+		if (reldistinct > 0)
+		{
+			relmaxndistinct = reldistinct;
+			relvarcount++;
+		}
+		else
+			reldistinct = 1.0;
+
+		/*
+		 * Get the product of numdistinct estimates of the remaining Vars.
+		 */
+		foreach(l, relvarinfos)
+		{
+			GroupVarInfo *varinfo2 = (GroupVarInfo *) lfirst(l);
+
+			reldistinct *= varinfo2->ndistinct;
+			if (relmaxndistinct < varinfo2->ndistinct)
+				relmaxndistinct = varinfo2->ndistinct;
+			relvarcount++;
+		}
+
 		/*
 		 * Sanity check --- don't divide by zero if empty relation.
 		 */
@@ -4424,7 +4578,7 @@ examine_variable(PlannerInfo *root, Node *node, int varRelid,
 						 * should match has_unique_index().
 						 */
 						if (index->unique &&
-							index->ncolumns == 1 &&
+							index->nkeycolumns == 1 &&
 							(index->indpred == NIL || index->predOK))
 							vardata->isunique = true;
 
@@ -6419,6 +6573,7 @@ btcostestimate(PG_FUNCTION_ARGS)
 	bool		found_saop;
 	bool		found_is_null_op;
 	double		num_sa_scans;
+	bool		skip_candidate;
 	ListCell   *lc;
 
 	/* Do preliminary analysis of indexquals */
@@ -6514,7 +6669,7 @@ btcostestimate(PG_FUNCTION_ARGS)
 	 * NullTest invalidates that theory, even though it sets eqQualHere.
 	 */
 	if (index->unique &&
-		indexcol == index->ncolumns - 1 &&
+		indexcol == index->nkeycolumns - 1 &&
 		eqQualHere &&
 		!found_saop &&
 		!found_is_null_op)
@@ -6585,6 +6740,26 @@ btcostestimate(PG_FUNCTION_ARGS)
 	costs.indexStartupCost += descentCost;
 	costs.indexTotalCost += costs.num_sa_scans * descentCost;
 
+	/*
+	 * If there are quals on the second column but none on the first, the
+	 * index AM will do a skip scan: one descent to find each distinct value
+	 * of the first column, and one to search within it using the quals on
+	 * the second column.  See _bt_preprocess_skip_key for the conditions
+	 * checked here.  We cost that below, once we have the first column's
+	 * statistics.
+	 */
+	skip_candidate = (index->nkeycolumns > 1 &&
+					  qinfos != NIL &&
+					  ((IndexQualInfo *) linitial(qinfos))->indexcol == 1);
+	foreach(lc, qinfos)
+	{
+		IndexQualInfo *qinfo = (IndexQualInfo *) lfirst(lc);
+
+		if (IsA(qinfo->rinfo->clause, ScalarArrayOpExpr) ||
+			IsA(qinfo->rinfo->clause, RowCompareExpr))
+			skip_candidate = false;
+	}
+
 	/*
 	 * If we can get an estimate of the first column's ordering correlation C
 	 * from pg_statistic, estimate the index correlation as C for a
@@ -6678,7 +6853,7 @@ btcostestimate(PG_FUNCTION_ARGS)
 			if (index->reverse_sort[0])
 				varCorrelation = -varCorrelation;
 
-			if (index->ncolumns > 1)
+			if (index->nkeycolumns > 1)
 				costs.indexCorrelation = varCorrelation * 0.75;
 			else
 				costs.indexCorrelation = varCorrelation;
@@ -6687,6 +6862,89 @@ btcostestimate(PG_FUNCTION_ARGS)
 		}
 	}
 
+	/*
+	 * Estimate the cost of a skip scan.  The boundary quals are found as
+	 * above, but starting from the second column, as the AM adds an '='
+	 * key for the first.  On top of the generic cost of reading the tuples
+	 * they select, each distinct value of the first column costs two
+	 * descents and, we assume, a visit to a leaf page of its own (which
+	 * can't add up to more than the whole index).  The AM gives up
+	 * skipping if the values turn out to be closely packed, so we charge
+	 * no more than the plain full-index scan costed above.
+	 */
+	if (skip_candidate)
+	{
+		GenericCosts skipcosts;
+		List	   *skipBoundQuals = NIL;
+		double		ndistinct;
+		bool		isdefault;
+		double		spc_random_page_cost;
+		Cost		skipDescentCost;
+
+		indexcol = 1;
+		eqQualHere = false;
+		foreach(lc, qinfos)
+		{
+			IndexQualInfo *qinfo = (IndexQualInfo *) lfirst(lc);
+
+			if (indexcol != qinfo->indexcol)
+			{
+				if (!eqQualHere)
+					break;
+				eqQualHere = false;
+				indexcol++;
+				if (indexcol != qinfo->indexcol)
+					break;
+			}
+
+			if (IsA(qinfo->rinfo->clause, NullTest))
+			{
+				if (((NullTest *) qinfo->rinfo->clause)->nulltesttype == IS_NULL)
+					eqQualHere = true;
+			}
+			else if (OidIsValid(qinfo->clause_op) &&
+					 get_op_opfamily_strategy(qinfo->clause_op,
+											  index->opfamily[indexcol]) ==
+					 BTEqualStrategyNumber)
+				eqQualHere = true;
+
+			skipBoundQuals = lappend(skipBoundQuals, qinfo->rinfo);
+		}
+
+		MemSet(&skipcosts, 0, sizeof(skipcosts));
+		skipcosts.numIndexTuples =
+			rint(clauselist_selectivity(root,
+										add_predicate_to_quals(index,
+															skipBoundQuals),
+										index->rel->relid,
+										JOIN_INNER,
+										NULL) * index->rel->tuples);
+		genericcostestimate(root, path, loop_count, qinfos, &skipcosts);
+
+		vardata.rel = index->rel;
+		if (!OidIsValid(vardata.vartype))
+			vardata.vartype = index->opcintype[0];
+		ndistinct = get_variable_numdistinct(&vardata, &isdefault);
+
+		get_tablespace_page_costs(index->reltablespace,
+								  &spc_random_page_cost, NULL);
+
+		skipDescentCost = (index->tree_height + 1) * 50.0 * cpu_operator_cost;
+		if (index->tuples > 1)
+			skipDescentCost += ceil(log(index->tuples) / log(2.0)) *
+				cpu_operator_cost;
+
+		skipcosts.indexStartupCost += 2 * skipDescentCost;
+		skipcosts.indexTotalCost += 2 * ndistinct * skipDescentCost +
+			Min(ndistinct, index->pages) * spc_random_page_cost;
+
+		if (skipcosts.indexTotalCost < costs.indexTotalCost)
+		{
+			costs.indexStartupCost = skipcosts.indexStartupCost;
+			costs.indexTotalCost = skipcosts.indexTotalCost;
+		}
+	}
+
 	ReleaseVariableStats(vardata);
 
 	*indexStartupCost = costs.indexStartupCost;
@@ -2220,6 +2220,7 @@ timestamp_cmp(PG_FUNCTION_ARGS)
 	PG_RETURN_INT32(timestamp_cmp_internal(dt1, dt2));
 }
 
+#if !defined(HAVE_INT64_TIMESTAMP) || !defined(USE_FLOAT8_BYVAL)
 /* note: this is used for timestamptz also */
 static int
 timestamp_fastcmp(Datum x, Datum y, SortSupport ssup)
@@ -2229,13 +2230,19 @@ timestamp_fastcmp(Datum x, Datum y, SortSupport ssup)
 
 	return timestamp_cmp_internal(a, b);
 }
+#endif
 
 Datum
 timestamp_sortsupport(PG_FUNCTION_ARGS)
 {
 	SortSupport ssup = (SortSupport) PG_GETARG_POINTER(0);
 
+	/* An integer timestamp passed by value is compared as a plain int64 */
+#if defined(HAVE_INT64_TIMESTAMP) && defined(USE_FLOAT8_BYVAL)
+	ssup->comparator = ssup_datum_signed_cmp;
+#else
 	ssup->comparator = timestamp_fastcmp;
+#endif
 	PG_RETURN_VOID();
 }
 
@@ -2519,6 +2526,57 @@ interval_cmp(PG_FUNCTION_ARGS)
 	PG_RETURN_INT32(interval_cmp_internal(interval1, interval2));
 }
 
+static int
+interval_fastcmp(Datum x, Datum y, SortSupport ssup)
+{
+	Interval   *a = DatumGetIntervalP(x);
+	Interval   *b = DatumGetIntervalP(y);
+
+	return interval_cmp_internal(a, b);
+}
+
+#if defined(HAVE_INT64_TIMESTAMP) && SIZEOF_DATUM == 8
+/*
+ * With integer datetimes, the net span computed by interval_cmp_value() is
+ * exactly what interval_cmp_internal() compares, and it fits in a Datum on
+ * 64-bit platforms.  So it serves as an abbreviated key that never loses
+ * information, and there's no point in estimating its cardinality.
+ */
+static Datum
+interval_abbrev_convert(Datum original, SortSupport ssup)
+{
+	Interval   *interval = DatumGetIntervalP(original);
+
+	return (Datum) interval_cmp_value(interval);
+}
+
+static bool
+interval_abbrev_abort(int memtupcount, SortSupport ssup)
+{
+	return false;
+}
+#endif
+
+Datum
+interval_sortsupport(PG_FUNCTION_ARGS)
+{
+	SortSupport ssup = (SortSupport) PG_GETARG_POINTER(0);
+
+	ssup->comparator = interval_fastcmp;
+
+#if defined(HAVE_INT64_TIMESTAMP) && SIZEOF_DATUM == 8
+	if (ssup->abbreviate)
+	{
+		ssup->abbrev_full_comparator = ssup->comparator;
+		ssup->comparator = ssup_datum_signed_cmp;
+		ssup->abbrev_converter = interval_abbrev_convert;
+		ssup->abbrev_abort = interval_abbrev_abort;
+	}
+#endif
+
+	PG_RETURN_VOID();
+}
+
 /*
  * Hashing for intervals
  *
@@ -34,8 +34,22 @@ static const float weights[] = {0.1f, 0.2f, 0.4f, 1.0f};
 #define RANK_NORM_RDIVRPLUS1	0x20
 #define DEF_NORM_METHOD			RANK_NO_NORM
 
-static float calc_rank_or(const float *w, TSVector t, TSQuery q);
-static float calc_rank_and(const float *w, TSVector t, TSQuery q);
+/*
+ * The sorted, de-duplicated operands of the last query seen by a ts_rank()
+ * call site, kept in fn_extra.  Ranking many rows against the same query
+ * then sorts its operands only once, rather than once per row.
+ */
+typedef struct
+{
+	TSQuery		query;			/* copy of the query */
+	QueryOperand **item;		/* its operands, pointing into the copy */
+	int			size;			/* number of entries in item[] */
+} RankQueryCache;
+
+static float calc_rank_or(const float *w, TSVector t, TSQuery q,
+			 QueryOperand **item, int size);
+static float calc_rank_and(const float *w, TSVector t, TSQuery q,
+			  QueryOperand **item, int size);
 
 /*
  * Returns a weight of a word collocation
@@ -197,7 +211,8 @@ SortAndUniqItems(TSQuery q, int *size)
 }
 
 static float
-calc_rank_and(const float *w, TSVector t, TSQuery q)
+calc_rank_and(const float *w, TSVector t, TSQuery q,
+			  QueryOperand **item, int size)
 {
 	WordEntryPosVector **pos;
 	WordEntryPosVector1 posnull;
@@ -215,15 +230,9 @@ calc_rank_and(const float *w, TSVector t, TSQuery q)
 				dist,
 				nitem;
 	float		res = -1.0;
-	QueryOperand **item;
-	int			size = q->size;
 
-	item = SortAndUniqItems(q, &size);
 	if (size < 2)
-	{
-		pfree(item);
-		return calc_rank_or(w, t, q);
-	}
+		return calc_rank_or(w, t, q, item, size);
 	pos = (WordEntryPosVector **) palloc0(sizeof(WordEntryPosVector *) * q->size);
 
 	/* A dummy WordEntryPos array to use when haspos is false */
@@ -275,12 +284,12 @@ calc_rank_and(const float *w, TSVector t, TSQuery q)
 		}
 	}
 	pfree(pos);
-	pfree(item);
 	return res;
 }
 
 static float
-calc_rank_or(const float *w, TSVector t, TSQuery q)
+calc_rank_or(const float *w, TSVector t, TSQuery q,
+			 QueryOperand **item, int size)
 {
 	WordEntry  *entry,
 			   *firstentry;
@@ -291,15 +300,11 @@ calc_rank_or(const float *w, TSVector t, TSQuery q)
 				i,
 				nitem;
 	float		res = 0.0;
-	QueryOperand **item;
-	int			size = q->size;
 
 	/* A dummy WordEntryPos array to use when haspos is false */
 	posnull.npos = 1;
 	posnull.pos[0] = 0;
 
-	item = SortAndUniqItems(q, &size);
-
 	for (i = 0; i < size; i++)
 	{
 		float		resj,
@@ -349,23 +354,79 @@ calc_rank_or(const float *w, TSVector t, TSQuery q)
 	}
 	if (size > 0)
 		res = res / size;
-	pfree(item);
 	return res;
 }
 
+/*
+ * Returns the sorted, de-duplicated operands of *q, like SortAndUniqItems.
+ *
+ * If the same query was seen by the previous call through this FmgrInfo,
+ * the operands sorted then are returned, and *q is replaced with the cached
+ * copy of the query that they point into.
+ */
+static QueryOperand **
+getSortedQueryItems(FunctionCallInfo fcinfo, TSQuery *q, int *size)
+{
+	FmgrInfo   *flinfo = fcinfo->flinfo;
+	RankQueryCache *cache;
+
+	if (flinfo == NULL)
+	{
+		*size = (*q)->size;
+		return SortAndUniqItems(*q, size);
+	}
+
+	cache = (RankQueryCache *) flinfo->fn_extra;
+	if (cache == NULL ||
+		VARSIZE(cache->query) != VARSIZE(*q) ||
+		memcmp(cache->query, *q, VARSIZE(*q)) != 0)
+	{
+		MemoryContext oldcxt = MemoryContextSwitchTo(flinfo->fn_mcxt);
+
+		if (cache == NULL)
+		{
+			cache = (RankQueryCache *) palloc(sizeof(RankQueryCache));
+			flinfo->fn_extra = cache;
+		}
+		else
+		{
+			pfree(cache->query);
+			pfree(cache->item);
+		}
+
+		cache->query = (TSQuery) palloc(VARSIZE(*q));
+		memcpy(cache->query, *q, VARSIZE(*q));
+		cache->size = cache->query->size;
+		cache->item = SortAndUniqItems(cache->query, &cache->size);
+
+		MemoryContextSwitchTo(oldcxt);
+	}
+
+	*q = cache->query;
+	*size = cache->size;
+	return cache->item;
+}
+
 static float
-calc_rank(const float *w, TSVector t, TSQuery q, int32 method)
+calc_rank(FunctionCallInfo fcinfo, const float *w, TSVector t, TSQuery q,
+		  int32 method)
 {
-	QueryItem  *item = GETQUERY(q);
+	QueryItem  *qitem;
+	QueryOperand **item;
+	int			size;
 	float		res = 0.0;
 	int			len;
 
 	if (!t->size || !q->size)
 		return 0.0;
 
+	item = getSortedQueryItems(fcinfo, &q, &size);
+	qitem = GETQUERY(q);
+
 	/* XXX: What about NOT? */
-	res = (item->type == QI_OPR && item->qoperator.oper == OP_AND) ?
-		calc_rank_and(w, t, q) : calc_rank_or(w, t, q);
+	res = (qitem->type == QI_OPR && qitem->qoperator.oper == OP_AND) ?
+		calc_rank_and(w, t, q, item, size) :
+		calc_rank_or(w, t, q, item, size);
 
 	if (res < 0)
 		res = 1e-20f;
@@ -441,7 +502,7 @@ ts_rank_wttf(PG_FUNCTION_ARGS)
 	int			method = PG_GETARG_INT32(3);
 	float		res;
 
-	res = calc_rank(getWeights(win), txt, query, method);
+	res = calc_rank(fcinfo, getWeights(win), txt, query, method);
 
 	PG_FREE_IF_COPY(win, 0);
 	PG_FREE_IF_COPY(txt, 1);
@@ -457,7 +518,7 @@ ts_rank_wtt(PG_FUNCTION_ARGS)
 	TSQuery		query = PG_GETARG_TSQUERY(2);
 	float		res;
 
-	res = calc_rank(getWeights(win), txt, query, DEF_NORM_METHOD);
+	res = calc_rank(fcinfo, getWeights(win), txt, query, DEF_NORM_METHOD);
 
 	PG_FREE_IF_COPY(win, 0);
 	PG_FREE_IF_COPY(txt, 1);
@@ -473,7 +534,7 @@ ts_rank_ttf(PG_FUNCTION_ARGS)
 	int			method = PG_GETARG_INT32(2);
 	float		res;
 
-	res = calc_rank(getWeights(NULL), txt, query, method);
+	res = calc_rank(fcinfo, getWeights(NULL), txt, query, method);
 
 	PG_FREE_IF_COPY(txt, 0);
 	PG_FREE_IF_COPY(query, 1);
@@ -487,7 +548,7 @@ ts_rank_tt(PG_FUNCTION_ARGS)
 	TSQuery		query = PG_GETARG_TSQUERY(1);
 	float		res;
 
-	res = calc_rank(getWeights(NULL), txt, query, DEF_NORM_METHOD);
+	res = calc_rank(fcinfo, getWeights(NULL), txt, query, DEF_NORM_METHOD);
 
 	PG_FREE_IF_COPY(txt, 0);
 	PG_FREE_IF_COPY(query, 1);
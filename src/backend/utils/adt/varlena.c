@@ -96,7 +96,10 @@ static text *text_substring(Datum str,
 			   bool length_not_specified);
 static text *text_overlay(text *t1, text *t2, int sp, int sl);
 static int	text_position(text *t1, text *t2);
+static int	text_position_toasted(struct varlena * t1, text *t2);
 static void text_position_setup(text *t1, text *t2, TextPositionState *state);
+static void text_position_setup_str(char *s1, int len1, char *s2, int len2,
+						TextPositionState *state);
 static int	text_position_next(int start_pos, TextPositionState *state);
 static void text_position_cleanup(TextPositionState *state);
 static int	text_cmp(text *arg1, text *arg2, Oid collid);
@@ -1062,10 +1065,13 @@ text_overlay(text *t1, text *t2, int sp, int sl)
 Datum
 textpos(PG_FUNCTION_ARGS)
 {
-	text	   *str = PG_GETARG_TEXT_PP(0);
+	struct varlena *str = (struct varlena *) PG_GETARG_POINTER(0);
 	text	   *search_str = PG_GETARG_TEXT_PP(1);
 
-	PG_RETURN_INT32((int32) text_position(str, search_str));
+	if (VARATT_IS_EXTERNAL(str) || VARATT_IS_COMPRESSED(str))
+		PG_RETURN_INT32((int32) text_position_toasted(str, search_str));
+
+	PG_RETURN_INT32((int32) text_position((text *) str, search_str));
 }
 
 /*
@@ -1094,6 +1100,50 @@ text_position(text *t1, text *t2)
 	return result;
 }
 
+/*
+ * text_position_toasted -
+ *	text_position() for a string that's stored out of line or compressed
+ *
+ * The string is detoasted a piece at a time, and each longer prefix of it
+ * is searched in turn, so that finding a match near the start of a long
+ * string doesn't require detoasting all of it.  The first match in a prefix
+ * is also the first match in the whole string, since all matches are of the
+ * same length.
+ */
+static int
+text_position_toasted(struct varlena * t1, text *t2)
+{
+	DetoastIterator iter = create_detoast_iterator(t1);
+	TextPositionState state;
+	int			result;
+
+	for (;;)
+	{
+		bool		complete;
+		int			len1;
+
+		detoast_iterate(iter);
+		complete = (iter->done >= iter->rawsize);
+
+		/* don't search a partial multibyte character at the end */
+		len1 = iter->done;
+		if (!complete)
+			len1 = pg_mbcliplen(VARDATA(iter->buf), len1, len1);
+
+		text_position_setup_str(VARDATA(iter->buf), len1,
+								VARDATA_ANY(t2), VARSIZE_ANY_EXHDR(t2),
+								&state);
+		result = text_position_next(1, &state);
+		text_position_cleanup(&state);
+
+		if (result > 0 || complete)
+			break;
+	}
+
+	free_detoast_iterator(iter);
+	return result;
+}
+
 
 /*
  * text_position_setup, text_position_next, text_position_cleanup -
@@ -1109,15 +1159,22 @@ text_position(text *t1, text *t2)
 static void
 text_position_setup(text *t1, text *t2, TextPositionState *state)
 {
-	int			len1 = VARSIZE_ANY_EXHDR(t1);
-	int			len2 = VARSIZE_ANY_EXHDR(t2);
+	text_position_setup_str(VARDATA_ANY(t1), VARSIZE_ANY_EXHDR(t1),
+							VARDATA_ANY(t2), VARSIZE_ANY_EXHDR(t2),
+							state);
+}
 
+/* As above, but for strings that aren't in text datums */
+static void
+text_position_setup_str(char *s1, int len1, char *s2, int len2,
+						TextPositionState *state)
+{
 	if (pg_database_encoding_max_length() == 1)
 	{
 		/* simple case - single byte encoding */
 		state->use_wchar = false;
-		state->str1 = VARDATA_ANY(t1);
-		state->str2 = VARDATA_ANY(t2);
+		state->str1 = s1;
+		state->str2 = s2;
 		state->len1 = len1;
 		state->len2 = len2;
 	}
@@ -1128,9 +1185,9 @@ text_position_setup(text *t1, text *t2, TextPositionState *state)
 				   *p2;
 
 		p1 = (pg_wchar *) palloc((len1 + 1) * sizeof(pg_wchar));
-		len1 = pg_mb2wchar_with_len(VARDATA_ANY(t1), p1, len1);
+		len1 = pg_mb2wchar_with_len(s1, p1, len1);
 		p2 = (pg_wchar *) palloc((len2 + 1) * sizeof(pg_wchar));
-		len2 = pg_mb2wchar_with_len(VARDATA_ANY(t2), p2, len2);
+		len2 = pg_mb2wchar_with_len(s2, p2, len2);
 
 		state->use_wchar = true;
 		state->wstr1 = p1;
@@ -4270,6 +4327,55 @@ pg_column_size(PG_FUNCTION_ARGS)
 	PG_RETURN_INT32(result);
 }
 
+/*
+ * Return the compression method of a stored datum, or NULL if it isn't
+ * compressed
+ *
+ * Works on any data type
+ */
+Datum
+pg_column_compression(PG_FUNCTION_ARGS)
+{
+	struct varlena *attr;
+	int			typlen;
+
+	/* On first call, get the input type's typlen, and save at *fn_extra */
+	if (fcinfo->flinfo->fn_extra == NULL)
+	{
+		/* Lookup the datatype of the supplied argument */
+		Oid			argtypeid = get_fn_expr_argtype(fcinfo->flinfo, 0);
+
+		typlen = get_typlen(argtypeid);
+		if (typlen == 0)		/* should not happen */
+			elog(ERROR, "cache lookup failed for type %u", argtypeid);
+
+		fcinfo->flinfo->fn_extra = MemoryContextAlloc(fcinfo->flinfo->fn_mcxt,
+													  sizeof(int));
+		*((int *) fcinfo->flinfo->fn_extra) = typlen;
+	}
+	else
+		typlen = *((int *) fcinfo->flinfo->fn_extra);
+
+	/* only varlenas are ever compressed */
+	if (typlen != -1)
+		PG_RETURN_NULL();
+
+	/*
+	 * The method is only recorded in the compressed data itself, so an
+	 * out-of-line value has to be fetched to find it.  For an expanded toast
+	 * value, look at the value it stands for.
+	 */
+	attr = (struct varlena *) DatumGetPointer(PG_GETARG_DATUM(0));
+	attr = toast_expanded_source(attr);
+	if (VARATT_IS_EXTERNAL(attr))
+		attr = heap_tuple_fetch_attr(attr);
+
+	if (!VARATT_IS_COMPRESSED(attr))
+		PG_RETURN_NULL();
+
+	PG_RETURN_TEXT_P(cstring_to_text(toast_compression_method_name(VARCOMPRESS_METHOD_4B_C(attr))));
+}
+
 /*
  * string_agg - Concatenates values and returns string.
  *
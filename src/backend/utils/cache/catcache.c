@@ -24,6 +24,7 @@
 #include "access/xact.h"
 #include "catalog/pg_operator.h"
 #include "catalog/pg_type.h"
+#include "funcapi.h"
 #include "miscadmin.h"
 #ifdef CATCACHE_STATS
 #include "storage/ipc.h"		/* for on_proc_exit */
@@ -35,8 +36,11 @@
 #include "utils/memutils.h"
 #include "utils/rel.h"
 #include "utils/resowner_private.h"
+#include "utils/sharedcatcache.h"
+#include "utils/snapmgr.h"
 #include "utils/syscache.h"
 #include "utils/tqual.h"
+#include "utils/tuplestore.h"
 
 
  /* #define CACHEDEBUG */	/* turns DEBUG elogs on */
@@ -72,6 +76,12 @@
 /* Cache management header --- pointer is NULL until created */
 static CatCacheHeader *CacheHdr = NULL;
 
+/* GUC variable */
+int			catalog_cache_limit = 0;
+
+/* Memory charged to catalog_cache_limit for one cache entry */
+#define CatCTupSize(ct)		(sizeof(CatCTup) + (ct)->tuple.t_len)
+
 
 static uint32 CatalogCacheComputeHashValue(CatCache *cache, int nkeys,
 							 ScanKey cur_skey);
@@ -83,6 +93,7 @@ static void CatCachePrintStats(int code, Datum arg);
 #endif
 static void CatCacheRemoveCTup(CatCache *cache, CatCTup *ct);
 static void CatCacheRemoveCList(CatCache *cache, CatCList *cl);
+static void CatCacheEvict(CatCTup *newest);
 static void CatalogCacheInitializeCache(CatCache *cache);
 static CatCTup *CatalogCacheCreateEntry(CatCache *cache, HeapTuple ntp,
 						uint32 hashValue, Index hashIndex,
@@ -373,8 +384,11 @@ CatCacheRemoveCTup(CatCache *cache, CatCTup *ct)
 		return;					/* nothing left to do */
 	}
 
-	/* delink from linked list */
+	/* delink from linked lists */
 	dlist_delete(&ct->cache_elem);
+	dlist_delete(&ct->lru_elem);
+
+	CacheHdr->ch_nbytes -= CatCTupSize(ct);
 
 	/* free associated tuple data */
 	if (ct->tuple.t_data != NULL)
@@ -385,6 +399,51 @@ CatCacheRemoveCTup(CatCache *cache, CatCTup *ct)
 	--CacheHdr->ch_ntup;
 }
 
+/*
+ *		CatCacheEvict
+ *
+ * Remove least recently used entries until the caches use no more memory
+ * than catalog_cache_limit allows, or until there is nothing left that can
+ * be removed.  Entries that are referenced, directly or through a CatCList,
+ * have to stay.  "newest" is the entry just added, at the head of the LRU
+ * list; it isn't referenced yet, but our caller is about to use it.
+ */
+static void
+CatCacheEvict(CatCTup *newest)
+{
+	Size		limit = (Size) catalog_cache_limit * 1024;
+	dlist_node *cur = dlist_tail_node(&CacheHdr->ch_lru);
+
+	while (CacheHdr->ch_nbytes > limit)
+	{
+		CatCTup    *ct = dlist_container(CatCTup, lru_elem, cur);
+		dlist_node *prev;
+
+		if (ct == newest)
+			break;				/* examined everything older */
+
+		prev = dlist_prev_node(&CacheHdr->ch_lru, cur);
+
+		if (ct->refcount == 0 &&
+			(ct->c_list == NULL || ct->c_list->refcount == 0))
+		{
+			bool		inlist = (ct->c_list != NULL);
+
+			ct->my_cache->cc_evictions++;
+			CatCacheRemoveCTup(ct->my_cache, ct);
+
+			/*
+			 * Removing the list may have removed other members of it too,
+			 * possibly including "prev", so start over from the tail.
+			 */
+			if (inlist)
+				prev = dlist_tail_node(&CacheHdr->ch_lru);
+		}
+
+		cur = prev;
+	}
+}
+
 /*
  *		CatCacheRemoveCList
  *
@@ -503,9 +562,7 @@ CatalogCacheIdInvalidate(int cacheId, uint32 hashValue)
 				else
 					CatCacheRemoveCTup(ccp, ct);
 				CACHE1_elog(DEBUG2, "CatalogCacheIdInvalidate: invalidated");
-#ifdef CATCACHE_STATS
 				ccp->cc_invals++;
-#endif
 				/* could be multiple matches, so keep looking! */
 			}
 		}
@@ -636,9 +693,7 @@ ResetCatalogCache(CatCache *cache)
 			}
 			else
 				CatCacheRemoveCTup(cache, ct);
-#ifdef CATCACHE_STATS
 			cache->cc_invals++;
-#endif
 		}
 	}
 }
@@ -764,6 +819,8 @@ InitCatCache(int id,
 		CacheHdr = (CatCacheHeader *) palloc(sizeof(CatCacheHeader));
 		slist_init(&CacheHdr->ch_caches);
 		CacheHdr->ch_ntup = 0;
+		CacheHdr->ch_nbytes = 0;
+		dlist_init(&CacheHdr->ch_lru);
 #ifdef CATCACHE_STATS
 		/* set up to dump stats at backend exit */
 		on_proc_exit(CatCachePrintStats, 0);
@@ -1122,6 +1179,9 @@ SearchCatCache(CatCache *cache,
 	Relation	relation;
 	SysScanDesc scandesc;
 	HeapTuple	ntp;
+	bool		useShared;
+	Oid			sharedDbId = InvalidOid;
+	uint64		generation = 0;
 
 	/* Make sure we're in an xact, even if this ends up being a cache hit */
 	Assert(IsTransactionState());
@@ -1132,9 +1192,7 @@ SearchCatCache(CatCache *cache,
 	if (cache->cc_tupdesc == NULL)
 		CatalogCacheInitializeCache(cache);
 
-#ifdef CATCACHE_STATS
 	cache->cc_searches++;
-#endif
 
 	/*
 	 * initialize the search key information
@@ -1188,6 +1246,7 @@ SearchCatCache(CatCache *cache,
 		 * near the front of the hashbucket's list.)
 		 */
 		dlist_move_head(bucket, &ct->cache_elem);
+		dlist_move_head(&CacheHdr->ch_lru, &ct->lru_elem);
 
 		/*
 		 * If it's a positive entry, bump its refcount and return it. If it's
@@ -1202,9 +1261,7 @@ SearchCatCache(CatCache *cache,
 			CACHE3_elog(DEBUG2, "SearchCatCache(%s): found in bucket %d",
 						cache->cc_relname, hashIndex);
 
-#ifdef CATCACHE_STATS
 			cache->cc_hits++;
-#endif
 
 			return &ct->tuple;
 		}
@@ -1213,9 +1270,7 @@ SearchCatCache(CatCache *cache,
 			CACHE3_elog(DEBUG2, "SearchCatCache(%s): found neg entry in bucket %d",
 						cache->cc_relname, hashIndex);
 
-#ifdef CATCACHE_STATS
 			cache->cc_neg_hits++;
-#endif
 
 			return NULL;
 		}
@@ -1235,7 +1290,54 @@ SearchCatCache(CatCache *cache,
 	 * will eventually age out of the cache, so there's no functional problem.
 	 * This case is rare enough that it's not worth expending extra cycles to
 	 * detect.
+	 *
+	 * Before reading the relation, though, see whether another backend has
+	 * already put the tuple into the shared catalog cache.  The shared cache
+	 * only matches on the hash value, so apply the key test here.  If we do
+	 * have to read the relation, use a catalog snapshot taken after the
+	 * shared lookup; SharedCatCacheInsert depends on that to recognize
+	 * tuples that were invalidated while we were reading them.
 	 */
+	useShared = SharedCatCacheUsable();
+	if (useShared)
+	{
+		bool		res;
+
+		sharedDbId = cache->cc_relisshared ? InvalidOid : MyDatabaseId;
+		ntp = SharedCatCacheLookup(cache->id, sharedDbId, hashValue,
+								   &generation);
+		if (ntp != NULL)
+		{
+			ntp->t_tableOid = cache->cc_reloid;
+			HeapKeyTest(ntp,
+						cache->cc_tupdesc,
+						cache->cc_nkeys,
+						cur_skey,
+						res);
+			if (res)
+			{
+				ct = CatalogCacheCreateEntry(cache, ntp,
+											 hashValue, hashIndex,
+											 false);
+				heap_freetuple(ntp);
+
+				ResourceOwnerEnlargeCatCacheRefs(CurrentResourceOwner);
+				ct->refcount++;
+				ResourceOwnerRememberCatCacheRef(CurrentResourceOwner, &ct->tuple);
+
+				CACHE3_elog(DEBUG2, "SearchCatCache(%s): put shared tuple in bucket %d",
+							cache->cc_relname, hashIndex);
+
+				cache->cc_newloads++;
+
+				return &ct->tuple;
+			}
+			heap_freetuple(ntp);
+		}
+
+		InvalidateCatalogSnapshot();
+	}
+
 	relation = heap_open(cache->cc_reloid, AccessShareLock);
 
 	scandesc = systable_beginscan(relation,
@@ -1263,6 +1365,10 @@ SearchCatCache(CatCache *cache,
 
 	heap_close(relation, AccessShareLock);
 
+	if (ct != NULL && useShared)
+		SharedCatCacheInsert(cache->id, sharedDbId, hashValue,
+							 &ct->tuple, generation);
+
 	/*
 	 * If tuple was not found, we need to build a negative cache entry
 	 * containing a fake tuple.  The fake tuple has the correct key columns,
@@ -1302,9 +1408,7 @@ SearchCatCache(CatCache *cache,
 	CACHE3_elog(DEBUG2, "SearchCatCache(%s): put in bucket %d",
 				cache->cc_relname, hashIndex);
 
-#ifdef CATCACHE_STATS
 	cache->cc_newloads++;
-#endif
 
 	return &ct->tuple;
 }
@@ -1421,9 +1525,7 @@ SearchCatCacheList(CatCache *cache,
 
 	Assert(nkeys > 0 && nkeys < cache->cc_nkeys);
 
-#ifdef CATCACHE_STATS
 	cache->cc_lsearches++;
-#endif
 
 	/*
 	 * initialize the search key information
@@ -1489,9 +1591,7 @@ SearchCatCacheList(CatCache *cache,
 		CACHE2_elog(DEBUG2, "SearchCatCacheList(%s): found list",
 					cache->cc_relname);
 
-#ifdef CATCACHE_STATS
 		cache->cc_lhits++;
-#endif
 
 		return cl;
 	}
@@ -1735,9 +1835,19 @@ CatalogCacheCreateEntry(CatCache *cache, HeapTuple ntp,
 	ct->hash_value = hashValue;
 
 	dlist_push_head(&cache->cc_bucket[hashIndex], &ct->cache_elem);
+	dlist_push_head(&CacheHdr->ch_lru, &ct->lru_elem);
 
 	cache->cc_ntup++;
 	CacheHdr->ch_ntup++;
+	CacheHdr->ch_nbytes += CatCTupSize(ct);
+
+	/*
+	 * If we're over the memory limit, make room by throwing out entries that
+	 * haven't been used for a while.
+	 */
+	if (catalog_cache_limit > 0 &&
+		CacheHdr->ch_nbytes > (Size) catalog_cache_limit * 1024)
+		CatCacheEvict(ct);
 
 	/*
 	 * If the hash table has become too full, enlarge the buckets array. Quite
@@ -1936,3 +2046,102 @@ PrintCatCacheListLeakWarning(CatCList *list)
 		 list->my_cache->cc_relname, list->my_cache->id,
 		 list, list->refcount);
 }
+
+/*
+ * SQL-callable function returning the statistics of this backend's catalog
+ * caches, one row per cache.
+ */
+Datum
+pg_stat_get_catcache(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	slist_iter	iter;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	/* need to build tuplestore in query context */
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	/*
+	 * build tupdesc for result tuples. This must match the definition of the
+	 * pg_stat_catcache view in system_views.sql
+	 */
+	tupdesc = CreateTemplateTupleDesc(10, false);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 1, "cacheid",
+					   INT4OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 2, "relid",
+					   OIDOID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 3, "indexrelid",
+					   OIDOID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 4, "entries",
+					   INT4OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 5, "searches",
+					   INT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 6, "hits",
+					   INT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 7, "neg_hits",
+					   INT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 8, "misses",
+					   INT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 9, "invalidations",
+					   INT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 10, "evictions",
+					   INT8OID, -1, 0);
+
+	tupstore =
+		tuplestore_begin_heap(rsinfo->allowedModes & SFRM_Materialize_Random,
+							  false, work_mem);
+
+	/* generate junk in short-term context */
+	MemoryContextSwitchTo(oldcontext);
+
+	if (CacheHdr != NULL)
+	{
+		slist_foreach(iter, &CacheHdr->ch_caches)
+		{
+			CatCache   *cache = slist_container(CatCache, cc_next, iter.cur);
+			Datum		values[10];
+			bool		nulls[10];
+
+			MemSet(nulls, 0, sizeof(nulls));
+
+			values[0] = Int32GetDatum(cache->id);
+			values[1] = ObjectIdGetDatum(cache->cc_reloid);
+			values[2] = ObjectIdGetDatum(cache->cc_indexoid);
+			values[3] = Int32GetDatum(cache->cc_ntup);
+			values[4] = Int64GetDatum((int64) cache->cc_searches);
+			values[5] = Int64GetDatum((int64) cache->cc_hits);
+			values[6] = Int64GetDatum((int64) cache->cc_neg_hits);
+			values[7] = Int64GetDatum((int64) (cache->cc_searches -
+											   cache->cc_hits -
+											   cache->cc_neg_hits));
+			values[8] = Int64GetDatum((int64) cache->cc_invals);
+			values[9] = Int64GetDatum((int64) cache->cc_evictions);
+
+			tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+		}
+	}
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	return (Datum) 0;
+}
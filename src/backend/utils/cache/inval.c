@@ -1029,6 +1029,19 @@ AtEOSubXact_Inval(bool isCommit)
 	}
 }
 
+/*
+ * InvalidationMessagesPending
+ *		Has the current transaction queued any invalidation messages?
+ *
+ * If it has, it has probably modified the system catalogs, and what it
+ * reads from them isn't necessarily what other backends would see.
+ */
+bool
+InvalidationMessagesPending(void)
+{
+	return transInvalInfo != NULL;
+}
+
 /*
  * CommandEndInvalidationMessages
  *		Process queued-up invalidation messages at end of one command
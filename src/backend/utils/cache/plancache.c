@@ -51,6 +51,7 @@
 
 #include "access/transam.h"
 #include "catalog/namespace.h"
+#include "catalog/pg_statistic.h"
 #include "executor/executor.h"
 #include "executor/spi.h"
 #include "miscadmin.h"
@@ -63,10 +64,13 @@
 #include "storage/lmgr.h"
 #include "tcop/pquery.h"
 #include "tcop/utility.h"
+#include "utils/fmgroids.h"
 #include "utils/inval.h"
+#include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/resowner_private.h"
 #include "utils/rls.h"
+#include "utils/sharedplancache.h"
 #include "utils/snapmgr.h"
 #include "utils/syscache.h"
 
@@ -87,13 +91,43 @@
  */
 static CachedPlanSource *first_saved_plan = NULL;
 
+/* GUC parameter */
+int			plan_cache_mode = PLAN_CACHE_MODE_AUTO;
+
+/*
+ * Parameter classes distinguish at most this many parameters, using
+ * PLAN_CLASS_BITS bits of the class identifier for each; see
+ * plan_param_class.
+ */
+#define PLAN_CLASS_MAX_PARAMS	4
+#define PLAN_CLASS_BITS			2
+
+typedef struct
+{
+	ParamListInfo boundParams;	/* parameter values being classified */
+	List	   *rtable;			/* range table of the current Query */
+	uint32		param_class;	/* class identifier built so far */
+	int			nparams;		/* number of parameters classified so far */
+} plan_param_class_context;
+
 static void ReleaseGenericPlan(CachedPlanSource *plansource);
 static List *RevalidateCachedQuery(CachedPlanSource *plansource);
 static bool CheckCachedPlan(CachedPlanSource *plansource);
 static CachedPlan *BuildCachedPlan(CachedPlanSource *plansource, List *qlist,
 				ParamListInfo boundParams);
+static CachedPlan *FetchSharedPlan(CachedPlanSource *plansource,
+				uint64 generation);
+static bool plansource_is_shareable(CachedPlanSource *plansource);
 static bool choose_custom_plan(CachedPlanSource *plansource,
-				   ParamListInfo boundParams);
+				   ParamListInfo boundParams, uint32 param_class);
+static uint32 plan_param_class(CachedPlanSource *plansource,
+				 ParamListInfo boundParams);
+static void plan_param_class_opexpr(OpExpr *opexpr,
+						plan_param_class_context *context);
+static bool plan_param_class_walker(Node *node,
+						plan_param_class_context *context);
+static CachedPlanClass *find_plan_class(CachedPlanSource *plansource,
+				uint32 param_class, bool create);
 static double cached_plan_cost(CachedPlan *plan, bool include_planner);
 static void AcquireExecutorLocks(List *stmt_list, bool acquire);
 static void AcquirePlannerLocks(List *stmt_list, bool acquire);
@@ -207,6 +241,7 @@ CreateCachedPlan(Node *raw_parse_tree,
 	plansource->generic_cost = -1;
 	plansource->total_custom_cost = 0;
 	plansource->num_custom_plans = 0;
+	plansource->num_classes = 0;
 	plansource->hasRowSecurity = false;
 	plansource->rowSecurityDisabled
 		= (security_context & SECURITY_ROW_LEVEL_DISABLED) != 0;
@@ -277,6 +312,7 @@ CreateOneShotCachedPlan(Node *raw_parse_tree,
 	plansource->generic_cost = -1;
 	plansource->total_custom_cost = 0;
 	plansource->num_custom_plans = 0;
+	plansource->num_classes = 0;
 
 	return plansource;
 }
@@ -1009,14 +1045,92 @@ BuildCachedPlan(CachedPlanSource *plansource, List *qlist,
 	return plan;
 }
 
+/*
+ * FetchSharedPlan: get a generic plan from the shared plan cache.
+ *
+ * Returns NULL if there is no usable shared plan for the plansource.
+ * 'generation' is the shared plan cache generation noted by the caller
+ * before the lookup.  Otherwise, the result is like that of a call to
+ * BuildCachedPlan for a generic plan, except that we also hold executor
+ * locks on the plan's relations: since no planning was done, nothing else
+ * has locked the relations the plan adds to those of the querytree, such
+ * as inheritance children.
+ */
+static CachedPlan *
+FetchSharedPlan(CachedPlanSource *plansource, uint64 generation)
+{
+	CachedPlan *plan;
+	List	   *plist;
+	SharedPlanStats stats;
+	MemoryContext plan_context;
+	MemoryContext oldcxt = CurrentMemoryContext;
+
+	/* The plan is read directly into its own context */
+	plan_context = AllocSetContextCreate(CurrentMemoryContext,
+										 "CachedPlan",
+										 ALLOCSET_SMALL_MINSIZE,
+										 ALLOCSET_SMALL_INITSIZE,
+										 ALLOCSET_DEFAULT_MAXSIZE);
+	MemoryContextSwitchTo(plan_context);
+
+	if (!SharedPlanCacheLookup(plansource, &stats, &plist))
+	{
+		MemoryContextSwitchTo(oldcxt);
+		MemoryContextDelete(plan_context);
+		return NULL;
+	}
+
+	MemoryContextSwitchTo(oldcxt);
+
+	/*
+	 * Lock the relations, then make sure that neither the shared plan nor
+	 * our querytree was invalidated while we weren't holding the locks.
+	 */
+	AcquireExecutorLocks(plist, true);
+
+	if (!plansource->is_valid ||
+		SharedPlanCacheGeneration() != generation)
+	{
+		AcquireExecutorLocks(plist, false);
+		MemoryContextDelete(plan_context);
+		return NULL;
+	}
+
+	/*
+	 * Create and fill the CachedPlan struct within the new context.  Shared
+	 * plans are never transient.
+	 */
+	MemoryContextSwitchTo(plan_context);
+
+	plan = (CachedPlan *) palloc(sizeof(CachedPlan));
+	plan->magic = CACHEDPLAN_MAGIC;
+	plan->stmt_list = plist;
+	plan->saved_xmin = InvalidTransactionId;
+	plan->refcount = 0;
+	plan->context = plan_context;
+	plan->is_oneshot = false;
+	plan->is_saved = false;
+	plan->is_valid = true;
+
+	/* assign generation number to new plan */
+	plan->generation = ++(plansource->generation);
+
+	MemoryContextSwitchTo(oldcxt);
+
+	return plan;
+}
+
 /*
  * choose_custom_plan: choose whether to use custom or generic plan
  *
- * This defines the policy followed by GetCachedPlan.
+ * This defines the policy followed by GetCachedPlan.  param_class is the
+ * class of the parameter values, as computed by plan_param_class.
  */
 static bool
-choose_custom_plan(CachedPlanSource *plansource, ParamListInfo boundParams)
+choose_custom_plan(CachedPlanSource *plansource, ParamListInfo boundParams,
+				   uint32 param_class)
 {
+	CachedPlanClass *pclass;
 	double		avg_custom_cost;
 
 	/* One-shot plans will always be considered custom */
@@ -1036,11 +1150,33 @@ choose_custom_plan(CachedPlanSource *plansource, ParamListInfo boundParams)
 	if (plansource->cursor_options & CURSOR_OPT_CUSTOM_PLAN)
 		return true;
 
+	/* Next, see if the user does */
+	if (plan_cache_mode == PLAN_CACHE_MODE_FORCE_GENERIC_PLAN)
+		return false;
+	if (plan_cache_mode == PLAN_CACHE_MODE_FORCE_CUSTOM_PLAN)
+		return true;
+
 	/* Generate custom plans until we have done at least 5 (arbitrary) */
 	if (plansource->num_custom_plans < 5)
 		return true;
 
-	avg_custom_cost = plansource->total_custom_cost / plansource->num_custom_plans;
+	/*
+	 * Compare against the custom plans made for parameter values of the
+	 * same class, if we have seen the class before.  A class we haven't
+	 * seen before gets a custom plan, so that we learn what custom plans
+	 * cost for it, as long as there's room to remember the result;
+	 * otherwise go by the custom plans made for all classes.  When we have
+	 * no cost history of our own at all, as when the statistics were
+	 * borrowed from the shared plan cache, don't experiment.
+	 */
+	pclass = find_plan_class(plansource, param_class, false);
+	if (pclass != NULL)
+		avg_custom_cost = pclass->total_custom_cost / pclass->num_custom_plans;
+	else if (plansource->num_classes > 0 &&
+			 plansource->num_classes < CACHEDPLAN_MAX_CLASSES)
+		return true;
+	else
+		avg_custom_cost = plansource->total_custom_cost / plansource->num_custom_plans;
 
 	/*
 	 * Prefer generic plan if it's less expensive than the average custom
@@ -1058,6 +1194,213 @@ choose_custom_plan(CachedPlanSource *plansource, ParamListInfo boundParams)
 	return true;
 }
 
+/*
+ * plan_param_class: classify a set of parameter values
+ *
+ * The best plan for a query often depends on whether a parameter compared
+ * to a table column is a common or a rare value of that column.  To let
+ * choose_custom_plan account for that, we sort parameter values into
+ * classes: every parameter compared to a plain table column with an
+ * equality operator in the query's WHERE and JOIN clauses contributes
+ * PLAN_CLASS_BITS bits to the class identifier, saying whether the value
+ * is among the column's most common values and, if so, roughly how
+ * common it is.  Other parameters don't affect the class, nor do
+ * parameters beyond the first PLAN_CLASS_MAX_PARAMS ones found.  Since
+ * a query's parameters are always visited in the same order, the same
+ * values always yield the same class.
+ */
+static uint32
+plan_param_class(CachedPlanSource *plansource, ParamListInfo boundParams)
+{
+	plan_param_class_context context;
+	ListCell   *lc;
+
+	context.boundParams = boundParams;
+	context.param_class = 0;
+	context.nparams = 0;
+
+	foreach(lc, plansource->query_list)
+	{
+		Query	   *query = (Query *) lfirst(lc);
+
+		Assert(IsA(query, Query));
+		if (query->commandType == CMD_UTILITY)
+			continue;
+		context.rtable = query->rtable;
+		(void) plan_param_class_walker((Node *) query->jointree, &context);
+	}
+
+	return context.param_class;
+}
+
+/*
+ * Classify the parameter in a "column = parameter" clause, per the MCV
+ * statistics of the column.
+ */
+static void
+plan_param_class_opexpr(OpExpr *opexpr, plan_param_class_context *context)
+{
+	ParamListInfo boundParams = context->boundParams;
+	Node	   *leftop;
+	Node	   *rightop;
+	Var		   *var;
+	Param	   *param;
+	bool		varonleft;
+	RangeTblEntry *rte;
+	ParamExternData *prm;
+	HeapTuple	statsTuple;
+	uint32		bucket = 0;
+
+	if (list_length(opexpr->args) != 2)
+		return;
+
+	leftop = (Node *) linitial(opexpr->args);
+	rightop = (Node *) lsecond(opexpr->args);
+	if (leftop && IsA(leftop, RelabelType))
+		leftop = (Node *) ((RelabelType *) leftop)->arg;
+	if (rightop && IsA(rightop, RelabelType))
+		rightop = (Node *) ((RelabelType *) rightop)->arg;
+
+	if (IsA(leftop, Var) && IsA(rightop, Param))
+	{
+		var = (Var *) leftop;
+		param = (Param *) rightop;
+		varonleft = true;
+	}
+	else if (IsA(leftop, Param) && IsA(rightop, Var))
+	{
+		var = (Var *) rightop;
+		param = (Param *) leftop;
+		varonleft = false;
+	}
+	else
+		return;
+
+	if (param->paramkind != PARAM_EXTERN ||
+		param->paramid <= 0 || param->paramid > boundParams->numParams ||
+		var->varlevelsup != 0 || var->varattno <= 0)
+		return;
+
+	if (get_oprrest(opexpr->opno) != F_EQSEL)
+		return;
+
+	rte = rt_fetch(var->varno, context->rtable);
+	if (rte->rtekind != RTE_RELATION)
+		return;
+
+	/* Give hook a chance in case parameter is dynamic */
+	prm = &boundParams->params[param->paramid - 1];
+	if (!OidIsValid(prm->ptype) && boundParams->paramFetch != NULL)
+		(*boundParams->paramFetch) (boundParams, param->paramid);
+
+	/* From here on, the parameter takes up its bits in the class */
+	if (OidIsValid(prm->ptype) && !prm->isnull)
+	{
+		statsTuple = SearchSysCache3(STATRELATTINH,
+									 ObjectIdGetDatum(rte->relid),
+									 Int16GetDatum(var->varattno),
+									 BoolGetDatum(rte->inh));
+		if (HeapTupleIsValid(statsTuple))
+		{
+			Datum	   *values;
+			int			nvalues;
+			float4	   *numbers;
+			int			nnumbers;
+
+			if (get_attstatsslot(statsTuple, var->vartype, var->vartypmod,
+								 STATISTIC_KIND_MCV, InvalidOid,
+								 NULL,
+								 &values, &nvalues,
+								 &numbers, &nnumbers))
+			{
+				FmgrInfo	eqproc;
+				int			i;
+
+				fmgr_info(get_opcode(opexpr->opno), &eqproc);
+
+				for (i = 0; i < nvalues && i < nnumbers; i++)
+				{
+					bool		match;
+
+					if (varonleft)
+						match = DatumGetBool(FunctionCall2Coll(&eqproc,
+													   opexpr->inputcollid,
+															   values[i],
+															 prm->value));
+					else
+						match = DatumGetBool(FunctionCall2Coll(&eqproc,
+													   opexpr->inputcollid,
+															 prm->value,
+															  values[i]));
+					if (match)
+					{
+						/* buckets 1..3 for frequencies <1%, <10%, more */
+						if (numbers[i] < 0.01)
+							bucket = 1;
+						else if (numbers[i] < 0.1)
+							bucket = 2;
+						else
+							bucket = 3;
+						break;
+					}
+				}
+
+				free_attstatsslot(var->vartype, values, nvalues,
+								  numbers, nnumbers);
+			}
+			ReleaseSysCache(statsTuple);
+		}
+	}
+
+	context->param_class |= bucket << (context->nparams * PLAN_CLASS_BITS);
+	context->nparams++;
+}
+
+static bool
+plan_param_class_walker(Node *node, plan_param_class_context *context)
+{
+	if (node == NULL)
+		return false;
+	if (context->nparams >= PLAN_CLASS_MAX_PARAMS)
+		return true;			/* no room for more, so stop looking */
+	/* don't look into sub-selects; their Vars aren't in our rtable */
+	if (IsA(node, Query))
+		return false;
+	if (IsA(node, OpExpr))
+		plan_param_class_opexpr((OpExpr *) node, context);
+	return expression_tree_walker(node, plan_param_class_walker,
+								  (void *) context);
+}
+
+/*
+ * find_plan_class: look up the cost history of a parameter class
+ *
+ * If create is true and the class is not known yet, a new entry is made,
+ * if there's room for it.  Returns NULL if no entry was found or made.
+ */
+static CachedPlanClass *
+find_plan_class(CachedPlanSource *plansource, uint32 param_class, bool create)
+{
+	CachedPlanClass *pclass;
+	int			i;
+
+	for (i = 0; i < plansource->num_classes; i++)
+	{
+		if (plansource->classes[i].param_class == param_class)
+			return &plansource->classes[i];
+	}
+
+	if (!create || plansource->num_classes >= CACHEDPLAN_MAX_CLASSES)
+		return NULL;
+
+	pclass = &plansource->classes[plansource->num_classes++];
+	pclass->param_class = param_class;
+	pclass->total_custom_cost = 0;
+	pclass->num_custom_plans = 0;
+
+	return pclass;
+}
+
 /*
  * cached_plan_cost: calculate estimated cost of a plan
  *
@@ -1137,6 +1480,8 @@ GetCachedPlan(CachedPlanSource *plansource, ParamListInfo boundParams,
 	CachedPlan *plan;
 	List	   *qlist;
 	bool		customplan;
+	bool		shareable;
+	uint32		param_class = 0;
 
 	/* Assert caller is doing things in a sane order */
 	Assert(plansource->magic == CACHEDPLANSOURCE_MAGIC);
@@ -1148,8 +1493,39 @@ GetCachedPlan(CachedPlanSource *plansource, ParamListInfo boundParams,
 	/* Make sure the querytree list is valid and we have parse-time locks */
 	qlist = RevalidateCachedQuery(plansource);
 
+	shareable = plansource_is_shareable(plansource);
+
+	/*
+	 * Until we have made a plan of our own, go by the planning statistics
+	 * of a shared generic plan, if there is one.  That lets us use the
+	 * generic plan right away if other sessions have found it to be as good
+	 * as custom plans.
+	 */
+	if (shareable && boundParams != NULL &&
+		plansource->num_custom_plans == 0 && plansource->generic_cost < 0)
+	{
+		SharedPlanStats stats;
+
+		if (SharedPlanCacheLookup(plansource, &stats, NULL))
+		{
+			plansource->generic_cost = stats.generic_cost;
+			plansource->total_custom_cost = stats.total_custom_cost;
+			plansource->num_custom_plans = stats.num_custom_plans;
+		}
+	}
+
+	/*
+	 * Classify the parameter values, unless the choice of plan is forced
+	 * anyway
+	 */
+	if (boundParams != NULL && !plansource->is_oneshot &&
+		plan_cache_mode == PLAN_CACHE_MODE_AUTO &&
+		!(plansource->cursor_options &
+		  (CURSOR_OPT_GENERIC_PLAN | CURSOR_OPT_CUSTOM_PLAN)))
+		param_class = plan_param_class(plansource, boundParams);
+
 	/* Decide whether to use a custom plan */
-	customplan = choose_custom_plan(plansource, boundParams);
+	customplan = choose_custom_plan(plansource, boundParams, param_class);
 
 	if (!customplan)
 	{
@@ -1161,8 +1537,28 @@ GetCachedPlan(CachedPlanSource *plansource, ParamListInfo boundParams,
 		}
 		else
 		{
-			/* Build a new generic plan */
-			plan = BuildCachedPlan(plansource, qlist, NULL);
+			uint64		generation = 0;
+			bool		publish = false;
+
+			/*
+			 * Build a new generic plan, unless another session has already
+			 * published one we can use.  Note the shared plan cache's
+			 * generation before planning, so that we don't publish a plan
+			 * that was invalidated while we were making it.
+			 */
+			plan = NULL;
+			if (shareable)
+			{
+				generation = SharedPlanCacheGeneration();
+				plan = FetchSharedPlan(plansource, generation);
+				if (plan == NULL)
+				{
+					generation = SharedPlanCacheGeneration();
+					publish = true;
+				}
+			}
+			if (plan == NULL)
+				plan = BuildCachedPlan(plansource, qlist, NULL);
 			/* Just make real sure plansource->gplan is clear */
 			ReleaseGenericPlan(plansource);
 			/* Link the new generic plan into the plansource */
@@ -1184,6 +1580,10 @@ GetCachedPlan(CachedPlanSource *plansource, ParamListInfo boundParams,
 			/* Update generic_cost whenever we make a new generic plan */
 			plansource->generic_cost = cached_plan_cost(plan, false);
 
+			/* Offer the plan to other sessions */
+			if (publish)
+				SharedPlanCacheInsert(plansource, plan->stmt_list, generation);
+
 			/*
 			 * If, based on the now-known value of generic_cost, we'd not have
 			 * chosen to use a generic plan, then forget it and make a custom
@@ -1193,7 +1593,8 @@ GetCachedPlan(CachedPlanSource *plansource, ParamListInfo boundParams,
 			 * find it's a loser, but we don't want to actually execute that
 			 * plan.
 			 */
-			customplan = choose_custom_plan(plansource, boundParams);
+			customplan = choose_custom_plan(plansource, boundParams,
+											param_class);
 
 			/*
 			 * If we choose to plan again, we need to re-copy the query_list,
@@ -1206,14 +1607,26 @@ GetCachedPlan(CachedPlanSource *plansource, ParamListInfo boundParams,
 
 	if (customplan)
 	{
+		double		custom_cost;
+		CachedPlanClass *pclass;
+
 		/* Build a custom plan */
 		plan = BuildCachedPlan(plansource, qlist, boundParams);
+		custom_cost = cached_plan_cost(plan, true);
+
 		/* Accumulate total costs of custom plans, but 'ware overflow */
 		if (plansource->num_custom_plans < INT_MAX)
 		{
-			plansource->total_custom_cost += cached_plan_cost(plan, true);
+			plansource->total_custom_cost += custom_cost;
 			plansource->num_custom_plans++;
 		}
+		/* ... and likewise for the parameter class */
+		pclass = find_plan_class(plansource, param_class, true);
+		if (pclass != NULL && pclass->num_custom_plans < INT_MAX)
+		{
+			pclass->total_custom_cost += custom_cost;
+			pclass->num_custom_plans++;
+		}
 	}
 
 	/* Flag the plan as in use by caller */
@@ -1392,6 +1805,9 @@ CopyCachedPlan(CachedPlanSource *plansource)
 	newsource->generic_cost = plansource->generic_cost;
 	newsource->total_custom_cost = plansource->total_custom_cost;
 	newsource->num_custom_plans = plansource->num_custom_plans;
+	newsource->num_classes = plansource->num_classes;
+	memcpy(newsource->classes, plansource->classes,
+		   plansource->num_classes * sizeof(CachedPlanClass));
 
 	MemoryContextSwitchTo(oldcxt);
 
@@ -1658,6 +2074,39 @@ plan_list_is_transient(List *stmt_list)
 	return false;
 }
 
+/*
+ * plansource_is_shareable: may the plansource use the shared plan cache?
+ *
+ * Only plain queries are shared, and only if they mean the same thing to
+ * every session with the same user and search path; see sharedplancache.c.
+ */
+static bool
+plansource_is_shareable(CachedPlanSource *plansource)
+{
+	ListCell   *lc;
+
+	if (!SharedPlanCacheUsable())
+		return false;
+
+	if (plansource->is_oneshot ||
+		plansource->parserSetup != NULL ||
+		plansource->hasRowSecurity ||
+		plansource->search_path == NULL ||
+		!plansource->is_valid)
+		return false;
+
+	foreach(lc, plansource->query_list)
+	{
+		Query	   *query = (Query *) lfirst(lc);
+
+		Assert(IsA(query, Query));
+		if (query->commandType == CMD_UTILITY)
+			return false;
+	}
+
+	return true;
+}
+
 /*
  * PlanCacheComputeResultDesc: given a list of analyzed-and-rewritten Queries,
  * determine the result tupledesc it will produce.  Returns NULL if the
@@ -58,6 +58,7 @@
 #include "catalog/storage.h"
 #include "commands/policy.h"
 #include "commands/trigger.h"
+#include "lib/ilist.h"
 #include "miscadmin.h"
 #include "optimizer/clauses.h"
 #include "optimizer/planmain.h"
@@ -109,10 +110,22 @@ typedef struct relidcacheent
 {
 	Oid			reloid;
 	Relation	reldesc;
+	dlist_node	lru_node;		/* link in RelationLRUList */
 } RelIdCacheEnt;
 
 static HTAB *RelationIdCache;
 
+/*
+ * All entries of RelationIdCache, most recently opened first.  This is used
+ * to pick entries to throw away when there are more than relation_cache_limit
+ * of them.  The links live in the hash entries rather than in RelationData,
+ * because rebuilding a relcache entry swaps most of RelationData's contents.
+ */
+static dlist_head RelationLRUList = DLIST_STATIC_INIT(RelationLRUList);
+
+/* GUC variable: maximum number of relcache entries, or 0 for no limit */
+int			relation_cache_limit = 0;
+
 /*
  * This flag is false until we have prepared the critical relcache entries
  * that are needed to do indexscans on the tables read by relcache building.
@@ -187,7 +200,10 @@ do { \
 				 RelationGetRelationName(_old_rel)); \
 	} \
 	else \
+	{ \
 		hentry->reldesc = (RELATION); \
+		dlist_push_head(&RelationLRUList, &hentry->lru_node); \
+	} \
 } while(0)
 
 #define RelationIdCacheLookup(ID, RELATION) \
@@ -211,6 +227,8 @@ do { \
 	if (hentry == NULL) \
 		elog(WARNING, "failed to delete relcache entry for OID %u", \
 			 (RELATION)->rd_id); \
+	else \
+		dlist_delete(&hentry->lru_node); \
 } while(0)
 
 
@@ -242,6 +260,7 @@ static void RelationReloadIndexInfo(Relation relation);
 static void RelationFlushRelation(Relation relation);
 static void RememberToFreeTupleDescAtEOX(TupleDesc td);
 static void AtEOXact_cleanup(Relation relation, bool isCommit);
+static void RelationCacheTrim(void);
 static void AtEOSubXact_cleanup(Relation relation, bool isCommit,
 					SubTransactionId mySubid, SubTransactionId parentSubid);
 static bool load_relcache_init_file(bool shared);
@@ -1290,11 +1309,12 @@ RelationInitIndexAccessInfo(Relation relation)
 	/*
 	 * Fill the support procedure OID array, as well as the info about
 	 * opfamilies and opclass input types.  (aminfo and supportinfo are left
-	 * as zeroes, and are filled on-the-fly when used)
+	 * as zeroes, and are filled on-the-fly when used)  Non-key INCLUDE
+	 * columns have no opclass; their entries stay zero.
 	 */
 	IndexSupportInitialize(indclass, relation->rd_support,
 						   relation->rd_opfamily, relation->rd_opcintype,
-						   amsupport, natts);
+						   amsupport, relation->rd_index->indnkeyatts);
 
 	/*
 	 * Similarly extract indoption and copy it to the cache entry
@@ -1733,6 +1753,7 @@ formrdesc(const char *relationName, Oid relationReltype,
 Relation
 RelationIdGetRelation(Oid relationId)
 {
+	RelIdCacheEnt *hentry;
 	Relation	rd;
 
 	/* Make sure we're in an xact, even if this ends up being a cache hit */
@@ -1741,10 +1762,14 @@ RelationIdGetRelation(Oid relationId)
 	/*
 	 * first try to find reldesc in the cache
 	 */
-	RelationIdCacheLookup(relationId, rd);
+	hentry = (RelIdCacheEnt *) hash_search(RelationIdCache,
+										   (void *) &relationId,
+										   HASH_FIND, NULL);
 
-	if (RelationIsValid(rd))
+	if (hentry != NULL)
 	{
+		rd = hentry->reldesc;
+		dlist_move_head(&RelationLRUList, &hentry->lru_node);
 		RelationIncrementReferenceCount(rd);
 		/* revalidate cache entry if necessary */
 		if (!rd->rd_isvalid)
@@ -2017,6 +2042,8 @@ RelationDestroyRelation(Relation relation, bool remember_tupdesc)
 		MemoryContextDelete(relation->rd_indexcxt);
 	if (relation->rd_rulescxt)
 		MemoryContextDelete(relation->rd_rulescxt);
+	if (relation->rd_checkcxt)
+		MemoryContextDelete(relation->rd_checkcxt);
 	if (relation->rd_rsdesc)
 		MemoryContextDelete(relation->rd_rsdesc->rscxt);
 	if (relation->rd_fdwroutine)
@@ -2603,6 +2630,54 @@ AtEOXact_RelationCache(bool isCommit)
 	eoxact_list_overflowed = false;
 	NextEOXactTupleDescNum = 0;
 	EOXactTupleDescArrayLen = 0;
+
+	/* Finally, shrink the cache if it has grown past its limit */
+	if (relation_cache_limit > 0 &&
+		hash_get_num_entries(RelationIdCache) > relation_cache_limit)
+		RelationCacheTrim();
+}
+
+/*
+ * RelationCacheTrim
+ *
+ *	Throw away least recently opened relcache entries until no more than
+ *	relation_cache_limit remain, or until nothing else can go.  Entries that
+ *	are open, nailed, or were created or given a new relfilenode by the
+ *	transaction have to stay.
+ *
+ *	This is done only at main-transaction end, when almost nothing is open
+ *	and nobody can be in the middle of a scan of RelationIdCache.
+ */
+static void
+RelationCacheTrim(void)
+{
+	long		nentries = hash_get_num_entries(RelationIdCache);
+	dlist_node *cur;
+
+	if (IsBootstrapProcessingMode() || dlist_is_empty(&RelationLRUList))
+		return;
+
+	cur = dlist_tail_node(&RelationLRUList);
+	while (cur != NULL && nentries > relation_cache_limit)
+	{
+		RelIdCacheEnt *hentry = dlist_container(RelIdCacheEnt, lru_node, cur);
+		Relation	relation = hentry->reldesc;
+		dlist_node *prev;
+
+		prev = dlist_has_prev(&RelationLRUList, cur) ?
+			dlist_prev_node(&RelationLRUList, cur) : NULL;
+
+		if (RelationHasReferenceCountZero(relation) &&
+			!relation->rd_isnailed &&
+			relation->rd_createSubid == InvalidSubTransactionId &&
+			relation->rd_newRelfilenodeSubid == InvalidSubTransactionId)
+		{
+			RelationClearRelation(relation, false);
+			nentries--;
+		}
+
+		cur = prev;
+	}
 }
 
 /*
@@ -4148,6 +4223,87 @@ RelationGetIndexPredicate(Relation relation)
 	return result;
 }
 
+/*
+ * RelationGetCheckConstraintExprs -- get the relation's CHECK constraints
+ *
+ * We cache the result of transforming the ccbin strings of the relation's
+ * validated CHECK constraints into a single implicit-AND node tree, with
+ * Vars having varno 1.  Constraints that are not yet validated are left out.
+ * If there are none, we return NIL.  Otherwise, the returned tree is copied
+ * into the caller's memory context.
+ */
+List *
+RelationGetCheckConstraintExprs(Relation relation)
+{
+	List	   *result = NIL;
+	TupleConstr *constr = relation->rd_att->constr;
+	MemoryContext checkcxt;
+	MemoryContext oldcxt;
+	int			i;
+
+	/* Quick exit if we already computed the result. */
+	if (relation->rd_checkexprs)
+		return (List *) copyObject(relation->rd_checkexprs);
+
+	/* Quick exit if there is nothing to do. */
+	if (constr == NULL || constr->num_check == 0)
+		return NIL;
+
+	/*
+	 * We build the tree we intend to return in the caller's context. After
+	 * successfully completing the work, we copy it into the relcache entry.
+	 * This avoids problems if we get some sort of error partway through.
+	 */
+	for (i = 0; i < constr->num_check; i++)
+	{
+		Node	   *cexpr;
+
+		if (!constr->check[i].ccvalid)
+			continue;
+
+		cexpr = stringToNode(constr->check[i].ccbin);
+
+		/*
+		 * Run each expression through const-simplification and
+		 * canonicalization.  This is not just an optimization, but is
+		 * necessary, because the planner will be comparing it to
+		 * similarly-processed qual clauses, and may fail to detect valid
+		 * matches without this.  This must match the processing done to qual
+		 * clauses in preprocess_expression()!  (We can skip the stuff
+		 * involving subqueries, however, since we don't allow any in check
+		 * constraints.)
+		 */
+		cexpr = eval_const_expressions(NULL, cexpr);
+
+		cexpr = (Node *) canonicalize_qual((Expr *) cexpr);
+
+		/* Convert to implicit-AND format and add to the result */
+		result = list_concat(result, make_ands_implicit((Expr *) cexpr));
+	}
+
+	if (result == NIL)
+		return NIL;
+
+	/* May as well fix opfuncids too */
+	fix_opfuncids((Node *) result);
+
+	/*
+	 * Now save a copy of the completed tree in the relcache entry, in a
+	 * private context so that a relcache reset can free it.
+	 */
+	checkcxt = AllocSetContextCreate(CacheMemoryContext,
+									 RelationGetRelationName(relation),
+									 ALLOCSET_SMALL_MINSIZE,
+									 ALLOCSET_SMALL_INITSIZE,
+									 ALLOCSET_SMALL_MAXSIZE);
+	oldcxt = MemoryContextSwitchTo(checkcxt);
+	relation->rd_checkexprs = (List *) copyObject(result);
+	MemoryContextSwitchTo(oldcxt);
+	relation->rd_checkcxt = checkcxt;
+
+	return result;
+}
+
 /*
  * RelationGetIndexAttrBitmap -- get a bitmap of index attribute numbers
  *
@@ -4264,7 +4420,8 @@ RelationGetIndexAttrBitmap(Relation relation, IndexAttrBitmapKind attrKind)
 				indexattrs = bms_add_member(indexattrs,
 							   attrnum - FirstLowInvalidHeapAttributeNumber);
 
-				if (isKey)
+				/* INCLUDE columns have no part in uniqueness */
+				if (isKey && i < indexInfo->ii_NumIndexKeyAttrs)
 					uindexattrs = bms_add_member(uindexattrs,
 							   attrnum - FirstLowInvalidHeapAttributeNumber);
 
@@ -4836,7 +4993,8 @@ load_relcache_init_file(bool shared)
 		 * format is complex and subject to change).  They must be rebuilt if
 		 * needed by RelationCacheInitializePhase3.  This is not expected to
 		 * be a big performance hit since few system catalogs have such. Ditto
-		 * for index expressions, predicates, exclusion info, and FDW info.
+		 * for index expressions, predicates, CHECK constraint expressions,
+		 * exclusion info, and FDW info.
 		 */
 		rel->rd_rules = NULL;
 		rel->rd_rulescxt = NULL;
@@ -4844,6 +5002,8 @@ load_relcache_init_file(bool shared)
 		rel->rd_rsdesc = NULL;
 		rel->rd_indexprs = NIL;
 		rel->rd_indpred = NIL;
+		rel->rd_checkexprs = NIL;
+		rel->rd_checkcxt = NULL;
 		rel->rd_exclops = NULL;
 		rel->rd_exclprocs = NULL;
 		rel->rd_exclstrats = NULL;
@@ -123,6 +123,8 @@ static void apply_map_update(RelMapFile *map, Oid relationId, Oid fileNode,
 static void merge_map_updates(RelMapFile *map, const RelMapFile *updates,
 				  bool add_okay);
 static void load_relmap_file(bool shared);
+static void read_relmap_file(RelMapFile *map, char *mapfilename,
+				 int elevel);
 static void write_relmap_file(bool shared, RelMapFile *newmap,
 				  bool write_wal, bool send_sinval, bool preserve_files,
 				  Oid dbid, Oid tsid, const char *dbpath);
@@ -626,8 +628,6 @@ load_relmap_file(bool shared)
 {
 	RelMapFile *map;
 	char		mapfilename[MAXPGPATH];
-	pg_crc32c	crc;
-	int			fd;
 
 	if (shared)
 	{
@@ -642,11 +642,23 @@ load_relmap_file(bool shared)
 		map = &local_map;
 	}
 
+	read_relmap_file(map, mapfilename, FATAL);
+}
+
+/*
+ * Read and validate a map file into *map, reporting any problem at elevel.
+ */
+static void
+read_relmap_file(RelMapFile *map, char *mapfilename, int elevel)
+{
+	pg_crc32c	crc;
+	int			fd;
+
 	/* Read data ... */
 	fd = OpenTransientFile(mapfilename,
 						   O_RDONLY | PG_BINARY, S_IRUSR | S_IWUSR);
 	if (fd < 0)
-		ereport(FATAL,
+		ereport(elevel,
 				(errcode_for_file_access(),
 				 errmsg("could not open relation mapping file \"%s\": %m",
 						mapfilename)));
@@ -659,7 +671,7 @@ load_relmap_file(bool shared)
 	 * are able to access any relation that's affected by the change.
 	 */
 	if (read(fd, map, sizeof(RelMapFile)) != sizeof(RelMapFile))
-		ereport(FATAL,
+		ereport(elevel,
 				(errcode_for_file_access(),
 				 errmsg("could not read relation mapping file \"%s\": %m",
 						mapfilename)));
@@ -670,7 +682,7 @@ load_relmap_file(bool shared)
 	if (map->magic != RELMAPPER_FILEMAGIC ||
 		map->num_mappings < 0 ||
 		map->num_mappings > MAX_MAPPINGS)
-		ereport(FATAL,
+		ereport(elevel,
 				(errmsg("relation mapping file \"%s\" contains invalid data",
 						mapfilename)));
 
@@ -680,7 +692,7 @@ load_relmap_file(bool shared)
 	FIN_CRC32C(crc);
 
 	if (!EQ_CRC32C(crc, map->crc))
-		ereport(FATAL,
+		ereport(elevel,
 		  (errmsg("relation mapping file \"%s\" contains incorrect checksum",
 				  mapfilename)));
 }
@@ -839,8 +851,12 @@ write_relmap_file(bool shared, RelMapFile *newmap,
 		}
 	}
 
-	/* Success, update permanent copy */
-	memcpy(realmap, newmap, sizeof(RelMapFile));
+	/*
+	 * Success, update permanent copy, unless this was the map of some other
+	 * database (see RelationMapCopy).
+	 */
+	if (shared || dbid == MyDatabaseId)
+		memcpy(realmap, newmap, sizeof(RelMapFile));
 
 	/* Critical section done */
 	if (write_wal)
@@ -897,6 +913,31 @@ perform_relmap_update(bool shared, const RelMapFile *updates)
 	LWLockRelease(RelationMappingLock);
 }
 
+/*
+ * RelationMapCopy
+ *
+ * Copy the local map file of database srcdbpath into the new database dbid
+ * in tablespace tsid, WAL-logging the contents.  This is used by CREATE
+ * DATABASE when it copies the template's relations block by block rather
+ * than copying its directories, so that the copy needs no checkpoint; the
+ * mapped relations keep their filenodes, so the map can be used as is.
+ *
+ * Nobody can be connected to the new database yet, so there is no need for
+ * locking or sinval.
+ */
+void
+RelationMapCopy(Oid dbid, Oid tsid, char *srcdbpath, char *dstdbpath)
+{
+	RelMapFile	map;
+	char		mapfilename[MAXPGPATH];
+
+	snprintf(mapfilename, sizeof(mapfilename), "%s/%s",
+			 srcdbpath, RELMAPPER_FILENAME);
+	read_relmap_file(&map, mapfilename, ERROR);
+
+	write_relmap_file(false, &map, true, false, false, dbid, tsid, dstdbpath);
+}
+
 /*
  * RELMAP resource manager's routines
  */
@@ -0,0 +1,465 @@
+/*-------------------------------------------------------------------------
+ *
+ * sharedcatcache.c
+ *	  Shared-memory catalog tuple cache.
+ *
+ * Every backend keeps its own catcache, and a freshly started backend has
+ * to fill it by scanning the system catalogs, which is a large part of the
+ * cost of a short-lived connection.  The shared catalog cache keeps copies
+ * of recently loaded catalog tuples in shared memory, so that when one
+ * backend misses its local catcache it can often pick up the tuple some
+ * other backend already read, instead of doing an index scan of its own.
+ *
+ * The cache is a set-associative array of fixed-size slots.  A slot holds
+ * one catalog tuple, identified by its syscache ID, its database (or
+ * InvalidOid for shared catalogs) and the hash value of its cache keys.
+ * Because only the hash value is matched here, the caller must apply the
+ * same key test to a tuple returned from the shared cache that it applies
+ * to its own cache entries.  Tuples too large to fit a slot, negative
+ * entries and catcache lists are simply not shared.  Slot replacement
+ * within a set uses a clock sweep over a "recently used" bit.
+ *
+ * The sets are divided among a fixed number of partitions, each with its
+ * own LWLock and a generation counter.  Entries are removed when the
+ * corresponding invalidation messages are sent to the shared invalidation
+ * queue; this happens after the invalidating transaction has become
+ * visible as committed, and before any other backend can have been told
+ * to drop its own copy.  Every removal also advances the partition's
+ * generation.  A backend loading a tuple from the catalog notes the
+ * generation before taking its catalog snapshot, and stores the tuple
+ * only if the generation is still the same, so that a tuple read just
+ * before a concurrent update committed cannot overwrite the removal.
+ *
+ * A backend must not publish what it sees in the catalogs while its own
+ * transaction has modified the catalogs, since other backends cannot see
+ * those changes yet; we recognize that case by the transaction having
+ * queued invalidation messages.  The cache is likewise bypassed during
+ * bootstrap, during recovery (including hot standby), and under a historic
+ * (logical decoding) snapshot.
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * IDENTIFICATION
+ *	  src/backend/utils/cache/sharedcatcache.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/hash.h"
+#include "access/htup_details.h"
+#include "access/xlog.h"
+#include "miscadmin.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/inval.h"
+#include "utils/sharedcatcache.h"
+#include "utils/snapmgr.h"
+
+
+/* Number of separately locked partitions */
+#define SHARED_CATCACHE_PARTITIONS	16
+
+/* Number of slots in each set */
+#define SHARED_CATCACHE_WAYS		4
+
+/* Largest tuple (t_len) that can be stored in a slot */
+#define SHARED_CATCACHE_TUPLE_SIZE	480
+
+typedef struct SharedCatCacheSlot
+{
+	int			cacheId;		/* syscache ID, or -1 if slot is empty */
+	Oid			dbId;			/* database ID, or 0 for a shared catalog */
+	uint32		hashValue;		/* hash value of the tuple's cache keys */
+	uint32		len;			/* t_len of the stored tuple */
+	ItemPointerData self;		/* t_self of the stored tuple */
+	bool		recent;			/* used since the clock hand last passed? */
+	union
+	{
+		char		data[SHARED_CATCACHE_TUPLE_SIZE];
+		double		force_align_d;
+		int64		force_align_i64;
+	}			tuple;
+} SharedCatCacheSlot;
+
+typedef struct SharedCatCacheSet
+{
+	int			hand;			/* next slot to consider for replacement */
+	SharedCatCacheSlot slots[SHARED_CATCACHE_WAYS];
+} SharedCatCacheSet;
+
+typedef struct SharedCatCachePartition
+{
+	LWLock		lock;			/* protects this partition's sets */
+	uint64		generation;		/* advanced whenever entries are removed */
+} SharedCatCachePartition;
+
+typedef struct SharedCatCacheCtl
+{
+	int			nsets;			/* number of sets in the sets[] array */
+	int			tranche_id;
+	LWLockTranche tranche;
+	SharedCatCachePartition partitions[SHARED_CATCACHE_PARTITIONS];
+	SharedCatCacheSet sets[FLEXIBLE_ARRAY_MEMBER];
+} SharedCatCacheCtl;
+
+/* GUC variable */
+int			shared_catcache_size = 0;
+
+/* Pointer to shared state, or NULL if the shared cache is disabled */
+static SharedCatCacheCtl *SharedCatCache = NULL;
+
+
+/*
+ * Number of sets that fit into shared_catcache_size, or 0 if disabled.
+ */
+static int
+SharedCatCacheNumSets(void)
+{
+	Size		avail;
+
+	if (shared_catcache_size <= 0)
+		return 0;
+
+	avail = (Size) shared_catcache_size * 1024;
+	if (avail <= offsetof(SharedCatCacheCtl, sets))
+		return 1;
+	avail -= offsetof(SharedCatCacheCtl, sets);
+
+	return (int) Max(avail / sizeof(SharedCatCacheSet), 1);
+}
+
+Size
+SharedCatCacheShmemSize(void)
+{
+	int			nsets = SharedCatCacheNumSets();
+
+	if (nsets == 0)
+		return 0;
+
+	return add_size(offsetof(SharedCatCacheCtl, sets),
+					mul_size(nsets, sizeof(SharedCatCacheSet)));
+}
+
+void
+SharedCatCacheShmemInit(void)
+{
+	bool		found;
+
+	if (shared_catcache_size <= 0)
+		return;
+
+	SharedCatCache = (SharedCatCacheCtl *)
+		ShmemInitStruct("Shared Catalog Cache",
+						SharedCatCacheShmemSize(),
+						&found);
+
+	if (!found)
+	{
+		int			i;
+		int			j;
+
+		MemSet(SharedCatCache, 0, SharedCatCacheShmemSize());
+
+		SharedCatCache->nsets = SharedCatCacheNumSets();
+		SharedCatCache->tranche_id = LWLockNewTrancheId();
+		SharedCatCache->tranche.name = "SharedCatCache";
+		SharedCatCache->tranche.array_base =
+			&SharedCatCache->partitions[0].lock;
+		SharedCatCache->tranche.array_stride =
+			sizeof(SharedCatCachePartition);
+
+		for (i = 0; i < SHARED_CATCACHE_PARTITIONS; i++)
+			LWLockInitialize(&SharedCatCache->partitions[i].lock,
+							 SharedCatCache->tranche_id);
+
+		for (i = 0; i < SharedCatCache->nsets; i++)
+			for (j = 0; j < SHARED_CATCACHE_WAYS; j++)
+				SharedCatCache->sets[i].slots[j].cacheId = -1;
+	}
+
+	LWLockRegisterTranche(SharedCatCache->tranche_id,
+						  &SharedCatCache->tranche);
+}
+
+/*
+ * Find the set a tuple belongs in, and the partition that covers it.
+ */
+static SharedCatCacheSet *
+SharedCatCacheGetSet(int cacheId, Oid dbId, uint32 hashValue,
+					 SharedCatCachePartition **partition)
+{
+	uint32		key[3];
+	uint32		setno;
+
+	key[0] = (uint32) cacheId;
+	key[1] = (uint32) dbId;
+	key[2] = hashValue;
+	setno = DatumGetUInt32(hash_any((unsigned char *) key, sizeof(key))) %
+		(uint32) SharedCatCache->nsets;
+
+	*partition =
+		&SharedCatCache->partitions[setno % SHARED_CATCACHE_PARTITIONS];
+	return &SharedCatCache->sets[setno];
+}
+
+/*
+ * SharedCatCacheUsable
+ *		May the current backend use the shared catalog cache right now?
+ */
+bool
+SharedCatCacheUsable(void)
+{
+	if (SharedCatCache == NULL)
+		return false;
+
+	/* no invalidation machinery yet, and nobody to share with */
+	if (IsBootstrapProcessingMode())
+		return false;
+
+	/* decoding sees the catalogs as of some point in the past */
+	if (HistoricSnapshotActive())
+		return false;
+
+	/* on a hot standby, stick to the local caches */
+	if (RecoveryInProgress())
+		return false;
+
+	/* our own uncommitted catalog changes must not leak out */
+	if (InvalidationMessagesPending())
+		return false;
+
+	return true;
+}
+
+/*
+ * SharedCatCacheLookup
+ *		Look for a tuple with the given syscache ID, database and hash value.
+ *
+ * Returns a palloc'd copy of the tuple, or NULL if none is cached.  The
+ * tuple's keys are not checked here; that is up to the caller.  t_tableOid
+ * is not set either.
+ *
+ * In any case, the partition's current generation is returned into
+ * *generation, for use by a later SharedCatCacheInsert.  The caller must
+ * not take the catalog snapshot used to load the tuple before this call.
+ */
+HeapTuple
+SharedCatCacheLookup(int cacheId, Oid dbId, uint32 hashValue,
+					 uint64 *generation)
+{
+	SharedCatCachePartition *partition;
+	SharedCatCacheSet *set;
+	HeapTuple	tuple = NULL;
+	int			i;
+
+	Assert(SharedCatCache != NULL);
+
+	set = SharedCatCacheGetSet(cacheId, dbId, hashValue, &partition);
+
+	LWLockAcquire(&partition->lock, LW_SHARED);
+
+	*generation = partition->generation;
+
+	for (i = 0; i < SHARED_CATCACHE_WAYS; i++)
+	{
+		SharedCatCacheSlot *slot = &set->slots[i];
+
+		if (slot->cacheId != cacheId ||
+			slot->hashValue != hashValue ||
+			slot->dbId != dbId)
+			continue;
+
+		tuple = (HeapTuple) palloc(HEAPTUPLESIZE + slot->len);
+		tuple->t_len = slot->len;
+		tuple->t_self = slot->self;
+		tuple->t_tableOid = InvalidOid;
+		tuple->t_data = (HeapTupleHeader) ((char *) tuple + HEAPTUPLESIZE);
+		memcpy(tuple->t_data, slot->tuple.data, slot->len);
+
+		/*
+		 * Setting the flag while holding only a shared lock is a harmless
+		 * race: at worst a concurrent replacement sweep misses it.
+		 */
+		slot->recent = true;
+		break;
+	}
+
+	LWLockRelease(&partition->lock);
+
+	return tuple;
+}
+
+/*
+ * SharedCatCacheInsert
+ *		Store a tuple just read from the catalogs.
+ *
+ * Nothing is stored if the tuple doesn't fit in a slot, or if entries in
+ * the partition have been invalidated since the caller obtained
+ * 'generation' from SharedCatCacheLookup, since the tuple might then be
+ * out of date already.  The tuple must not contain any toast pointers.
+ */
+void
+SharedCatCacheInsert(int cacheId, Oid dbId, uint32 hashValue,
+					 HeapTuple tuple, uint64 generation)
+{
+	SharedCatCachePartition *partition;
+	SharedCatCacheSet *set;
+	SharedCatCacheSlot *victim = NULL;
+	int			i;
+
+	Assert(SharedCatCache != NULL);
+	Assert(!HeapTupleHasExternal(tuple));
+
+	if (tuple->t_len > SHARED_CATCACHE_TUPLE_SIZE)
+		return;
+
+	set = SharedCatCacheGetSet(cacheId, dbId, hashValue, &partition);
+
+	LWLockAcquire(&partition->lock, LW_EXCLUSIVE);
+
+	if (partition->generation != generation)
+	{
+		LWLockRelease(&partition->lock);
+		return;
+	}
+
+	/*
+	 * Reuse a slot already holding this key, if someone beat us to it;
+	 * otherwise take an empty slot, or else run the clock.
+	 */
+	for (i = 0; i < SHARED_CATCACHE_WAYS; i++)
+	{
+		SharedCatCacheSlot *slot = &set->slots[i];
+
+		if (slot->cacheId == cacheId &&
+			slot->hashValue == hashValue &&
+			slot->dbId == dbId)
+		{
+			victim = slot;
+			break;
+		}
+		if (slot->cacheId < 0 && victim == NULL)
+			victim = slot;
+	}
+
+	while (victim == NULL)
+	{
+		SharedCatCacheSlot *slot = &set->slots[set->hand];
+
+		set->hand = (set->hand + 1) % SHARED_CATCACHE_WAYS;
+		if (slot->recent)
+			slot->recent = false;
+		else
+			victim = slot;
+	}
+
+	victim->cacheId = cacheId;
+	victim->dbId = dbId;
+	victim->hashValue = hashValue;
+	victim->len = tuple->t_len;
+	victim->self = tuple->t_self;
+	victim->recent = true;
+	memcpy(victim->tuple.data, tuple->t_data, tuple->t_len);
+
+	LWLockRelease(&partition->lock);
+}
+
+/*
+ * Remove the entries matching a catcache invalidation message.
+ */
+static void
+SharedCatCacheInvalidateEntry(int cacheId, Oid dbId, uint32 hashValue)
+{
+	SharedCatCachePartition *partition;
+	SharedCatCacheSet *set;
+	int			i;
+
+	set = SharedCatCacheGetSet(cacheId, dbId, hashValue, &partition);
+
+	LWLockAcquire(&partition->lock, LW_EXCLUSIVE);
+
+	for (i = 0; i < SHARED_CATCACHE_WAYS; i++)
+	{
+		SharedCatCacheSlot *slot = &set->slots[i];
+
+		if (slot->cacheId == cacheId &&
+			slot->hashValue == hashValue &&
+			slot->dbId == dbId)
+			slot->cacheId = -1;
+	}
+
+	/* even if nothing was found, a concurrent load must not store it */
+	partition->generation++;
+
+	LWLockRelease(&partition->lock);
+}
+
+/*
+ * SharedCatCacheInvalidateDatabase
+ *		Remove all entries belonging to the given database.
+ *
+ * Passing InvalidOid removes the entries from shared catalogs.
+ */
+void
+SharedCatCacheInvalidateDatabase(Oid dbId)
+{
+	int			p;
+
+	if (SharedCatCache == NULL)
+		return;
+
+	for (p = 0; p < SHARED_CATCACHE_PARTITIONS; p++)
+	{
+		SharedCatCachePartition *partition = &SharedCatCache->partitions[p];
+		int			i;
+
+		LWLockAcquire(&partition->lock, LW_EXCLUSIVE);
+
+		for (i = p; i < SharedCatCache->nsets; i += SHARED_CATCACHE_PARTITIONS)
+		{
+			SharedCatCacheSet *set = &SharedCatCache->sets[i];
+			int			j;
+
+			for (j = 0; j < SHARED_CATCACHE_WAYS; j++)
+			{
+				if (set->slots[j].dbId == dbId)
+					set->slots[j].cacheId = -1;
+			}
+		}
+
+		partition->generation++;
+
+		LWLockRelease(&partition->lock);
+	}
+}
+
+/*
+ * SharedCatCacheProcessMessages
+ *		Apply invalidation messages about to be sent to the SI queue.
+ *
+ * Catcache messages remove the matching entry.  A whole-catalog message
+ * removes everything belonging to its database; those are rare enough
+ * (VACUUM FULL or CLUSTER of a catalog) that it isn't worth mapping the
+ * catalog back to its syscaches.  Other message types don't concern us.
+ */
+void
+SharedCatCacheProcessMessages(const SharedInvalidationMessage *msgs, int n)
+{
+	int			i;
+
+	if (SharedCatCache == NULL)
+		return;
+
+	for (i = 0; i < n; i++)
+	{
+		const SharedInvalidationMessage *msg = &msgs[i];
+
+		if (msg->id >= 0)
+			SharedCatCacheInvalidateEntry(msg->cc.id, msg->cc.dbId,
+										  msg->cc.hashValue);
+		else if (msg->id == SHAREDINVALCATALOG_ID)
+			SharedCatCacheInvalidateDatabase(msg->cat.dbId);
+	}
+}
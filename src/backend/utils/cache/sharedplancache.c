@@ -0,0 +1,729 @@
+/*-------------------------------------------------------------------------
+ *
+ * sharedplancache.c
+ *	  Shared-memory cache of generic plans.
+ *
+ * A prepared statement's generic plan lives in the backend-local plan
+ * cache, so every new session has to plan each of its statements again,
+ * even when some other session has just planned the very same query.  The
+ * shared plan cache keeps serialized (nodeToString) copies of generic
+ * plans in shared memory, so that a backend about to build a generic plan
+ * can read one built elsewhere instead.  The planning statistics that
+ * plancache.c uses to choose between custom and generic plans are stored
+ * with the plan, so that a new session can also go straight to the generic
+ * plan for a query that has already proven not to need custom plans.
+ *
+ * An entry is identified by the database, the current user, the query
+ * text, the parameter types, the cursor options and the search path the
+ * query was parsed with, and by the settings that change the meaning of
+ * literals in the query text (see SharedPlanParseSettings): the parser
+ * coerces literals to constants using those, so, for instance, a
+ * timestamptz literal depends on TimeZone and DateStyle.  Queries whose
+ * meaning depends on anything else
+ * are not shared: those using a parser hook (such as PL/pgSQL variable
+ * references), those subject to row security, and all queries of a
+ * session that has temporary objects, which could shadow other objects of
+ * the same name.  Transient plans and plans containing custom or foreign
+ * scans, whose private data can't be relied on to survive a trip through
+ * the node reader, are not shared either.  Planner settings are not part
+ * of the key; a backend may be handed a plan built under different cost
+ * or enable_* settings, which gives the same results but might be
+ * suboptimal.
+ *
+ * The cache is a set-associative array of fixed-size slots protected by a
+ * single LWLock.  Plans are looked up only when a backend is about to
+ * build a generic plan, which is rare enough that the lock should not be
+ * contended.  Each slot records the relations and other objects the
+ * plans depend on, like the plans' relationOids and invalItems lists, and
+ * the slot is cleared when an invalidation message for one of them is
+ * sent to the shared invalidation queue, the same events that make
+ * plancache.c discard a local plan.  Plans depending on more objects than
+ * fit in a slot are not shared.  Every removal advances a generation
+ * counter; a backend notes the generation before planning and publishes
+ * its plan only if it has not changed since, and a backend that fetched a
+ * plan rechecks it after locking the plan's relations, like the shared
+ * catalog cache does.
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * IDENTIFICATION
+ *	  src/backend/utils/cache/sharedplancache.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/hash.h"
+#include "access/xlog.h"
+#include "catalog/namespace.h"
+#include "lib/stringinfo.h"
+#include "miscadmin.h"
+#include "nodes/plannodes.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/guc.h"
+#include "utils/inval.h"
+#include "utils/sharedplancache.h"
+#include "utils/syscache.h"
+
+
+/* Number of slots in each set */
+#define SHARED_PLAN_WAYS		4
+
+/* Space for parameter types, search path, query text and plan in a slot */
+#define SHARED_PLAN_DATA_SIZE	15360
+
+/*
+ * Settings that affect how the parser reads the query text or converts its
+ * literals to constants.  A plan is only shared between sessions that agree
+ * on all of them.
+ */
+static const char *const SharedPlanParseSettings[] = {
+	"DateStyle",
+	"IntervalStyle",
+	"TimeZone",
+	"timezone_abbreviations",
+	"lc_monetary",
+	"standard_conforming_strings",
+	"array_nulls",
+	"xmloption",
+	"transform_null_equals",
+	"sql_inheritance"
+};
+
+/* Most dependencies a shared plan may have */
+#define SHARED_PLAN_MAX_RELS	32
+#define SHARED_PLAN_MAX_ITEMS	16
+
+typedef struct SharedPlanInvalItem
+{
+	int			cacheId;		/* a syscache ID, see PlanInvalItem */
+	uint32		hashValue;		/* hash value of object's cache lookup key */
+} SharedPlanInvalItem;
+
+typedef struct SharedPlanSlot
+{
+	bool		inuse;			/* does the slot hold a plan? */
+	bool		recent;			/* used since the clock hand last passed? */
+	Oid			dbId;			/* database the plan belongs to */
+	Oid			roleId;			/* user the query was planned for */
+	uint32		keyHash;		/* hash of the lookup key */
+	int			cursor_options; /* cursor options used for planning */
+	int			num_params;		/* number of parameter type OIDs */
+	int			num_schemas;	/* number of search path schema OIDs */
+	bool		addCatalog;		/* search path flags, see namespace.h */
+	bool		addTemp;
+	int			settingslen;	/* length of settings string, excluding nul */
+	int			textlen;		/* length of query text, excluding nul */
+	int			planlen;		/* length of plan string, excluding nul */
+	SharedPlanStats stats;		/* publishing backend's plan statistics */
+	int			nrels;			/* dependencies, as in PlannedStmt */
+	Oid			relationOids[SHARED_PLAN_MAX_RELS];
+	int			nitems;
+	SharedPlanInvalItem invalItems[SHARED_PLAN_MAX_ITEMS];
+	/* parameter types, schema OIDs, settings, query text and plan */
+	union
+	{
+		char		data[SHARED_PLAN_DATA_SIZE];
+		Oid			force_align_oid;
+	}			data;
+} SharedPlanSlot;
+
+typedef struct SharedPlanSet
+{
+	int			hand;			/* next slot to consider for replacement */
+	SharedPlanSlot slots[SHARED_PLAN_WAYS];
+} SharedPlanSet;
+
+typedef struct SharedPlanCacheCtl
+{
+	LWLock		lock;			/* protects all of the below */
+	uint64		generation;		/* advanced whenever entries are removed */
+	int			nsets;			/* number of sets in the sets[] array */
+	int			tranche_id;
+	LWLockTranche tranche;
+	SharedPlanSet sets[FLEXIBLE_ARRAY_MEMBER];
+} SharedPlanCacheCtl;
+
+/* GUC variable */
+int			shared_plan_cache_size = 0;
+
+/* Pointer to shared state, or NULL if the shared plan cache is disabled */
+static SharedPlanCacheCtl *SharedPlanCache = NULL;
+
+
+/*
+ * Number of sets that fit into shared_plan_cache_size, or 0 if disabled.
+ */
+static int
+SharedPlanCacheNumSets(void)
+{
+	Size		avail;
+
+	if (shared_plan_cache_size <= 0)
+		return 0;
+
+	avail = (Size) shared_plan_cache_size * 1024;
+	if (avail <= offsetof(SharedPlanCacheCtl, sets))
+		return 1;
+	avail -= offsetof(SharedPlanCacheCtl, sets);
+
+	return (int) Max(avail / sizeof(SharedPlanSet), 1);
+}
+
+Size
+SharedPlanCacheShmemSize(void)
+{
+	int			nsets = SharedPlanCacheNumSets();
+
+	if (nsets == 0)
+		return 0;
+
+	return add_size(offsetof(SharedPlanCacheCtl, sets),
+					mul_size(nsets, sizeof(SharedPlanSet)));
+}
+
+void
+SharedPlanCacheShmemInit(void)
+{
+	bool		found;
+
+	if (shared_plan_cache_size <= 0)
+		return;
+
+	SharedPlanCache = (SharedPlanCacheCtl *)
+		ShmemInitStruct("Shared Plan Cache",
+						SharedPlanCacheShmemSize(),
+						&found);
+
+	if (!found)
+	{
+		MemSet(SharedPlanCache, 0, SharedPlanCacheShmemSize());
+
+		SharedPlanCache->nsets = SharedPlanCacheNumSets();
+		SharedPlanCache->tranche_id = LWLockNewTrancheId();
+		SharedPlanCache->tranche.name = "SharedPlanCache";
+		SharedPlanCache->tranche.array_base = &SharedPlanCache->lock;
+		SharedPlanCache->tranche.array_stride = sizeof(LWLock);
+		LWLockInitialize(&SharedPlanCache->lock, SharedPlanCache->tranche_id);
+	}
+
+	LWLockRegisterTranche(SharedPlanCache->tranche_id,
+						  &SharedPlanCache->tranche);
+}
+
+/*
+ * SharedPlanCacheUsable
+ *		May the current backend use the shared plan cache right now?
+ */
+bool
+SharedPlanCacheUsable(void)
+{
+	if (SharedPlanCache == NULL)
+		return false;
+
+	if (IsBootstrapProcessingMode())
+		return false;
+
+	/* on a hot standby, stick to the local plan cache */
+	if (RecoveryInProgress())
+		return false;
+
+	/* plans made against our own uncommitted catalog changes stay local */
+	if (InvalidationMessagesPending())
+		return false;
+
+	/* temporary objects could shadow what other sessions see */
+	if (isTempNamespaceInUse())
+		return false;
+
+	return true;
+}
+
+/*
+ * SharedPlanCacheGeneration
+ *		Return the current generation, for use by SharedPlanCacheInsert.
+ */
+uint64
+SharedPlanCacheGeneration(void)
+{
+	uint64		generation;
+
+	Assert(SharedPlanCache != NULL);
+
+	LWLockAcquire(&SharedPlanCache->lock, LW_SHARED);
+	generation = SharedPlanCache->generation;
+	LWLockRelease(&SharedPlanCache->lock);
+
+	return generation;
+}
+
+/*
+ * Return the current values of SharedPlanParseSettings as one palloc'd
+ * string.
+ */
+static char *
+SharedPlanSettingsString(void)
+{
+	StringInfoData buf;
+	int			i;
+
+	initStringInfo(&buf);
+	for (i = 0; i < lengthof(SharedPlanParseSettings); i++)
+		appendStringInfo(&buf, "%s\n",
+						 GetConfigOption(SharedPlanParseSettings[i],
+										 false, false));
+
+	return buf.data;
+}
+
+/*
+ * Compute the lookup key hash for a plan source, under the given settings.
+ */
+static uint32
+SharedPlanKeyHash(CachedPlanSource *plansource, const char *settings)
+{
+	uint32		key[6];
+
+	key[0] = DatumGetUInt32(hash_any((const unsigned char *) plansource->query_string,
+									 strlen(plansource->query_string)));
+	key[1] = (uint32) MyDatabaseId;
+	key[2] = (uint32) GetUserId();
+	key[3] = (uint32) plansource->cursor_options;
+	key[4] = (uint32) plansource->num_params;
+	key[5] = DatumGetUInt32(hash_any((const unsigned char *) settings,
+									 strlen(settings)));
+
+	return DatumGetUInt32(hash_any((unsigned char *) key, sizeof(key)));
+}
+
+/*
+ * Does the slot hold a plan for the given plan source and settings?
+ */
+static bool
+SharedPlanSlotMatches(SharedPlanSlot *slot, CachedPlanSource *plansource,
+					  const char *settings, uint32 keyHash)
+{
+	OverrideSearchPath *path = plansource->search_path;
+	char	   *data = slot->data.data;
+	ListCell   *lc;
+
+	if (!slot->inuse ||
+		slot->keyHash != keyHash ||
+		slot->dbId != MyDatabaseId ||
+		slot->roleId != GetUserId() ||
+		slot->cursor_options != plansource->cursor_options ||
+		slot->num_params != plansource->num_params ||
+		slot->num_schemas != list_length(path->schemas) ||
+		slot->addCatalog != path->addCatalog ||
+		slot->addTemp != path->addTemp ||
+		slot->settingslen != (int) strlen(settings))
+		return false;
+
+	if (slot->num_params > 0 &&
+		memcmp(data, plansource->param_types,
+			   slot->num_params * sizeof(Oid)) != 0)
+		return false;
+	data += slot->num_params * sizeof(Oid);
+
+	foreach(lc, path->schemas)
+	{
+		Oid			schema;
+
+		memcpy(&schema, data, sizeof(Oid));
+		if (schema != lfirst_oid(lc))
+			return false;
+		data += sizeof(Oid);
+	}
+
+	if (strcmp(data, settings) != 0)
+		return false;
+	data += slot->settingslen + 1;
+
+	return strcmp(data, plansource->query_string) == 0;
+}
+
+/*
+ * Find the set a plan source's entry belongs in.
+ */
+static SharedPlanSet *
+SharedPlanCacheGetSet(uint32 keyHash)
+{
+	return &SharedPlanCache->sets[keyHash % (uint32) SharedPlanCache->nsets];
+}
+
+/*
+ * SharedPlanCacheLookup
+ *		Look for a generic plan for the given plan source.
+ *
+ * Returns false if there is none.  Otherwise the publishing backend's
+ * planning statistics are returned into *stats, and if stmt_list isn't
+ * NULL, a freshly read copy of its statement list is returned into
+ * *stmt_list, allocated in the caller's memory context.  The caller must
+ * lock the plan's relations before using it, and must discard it if the
+ * generation has changed since a call to SharedPlanCacheGeneration made
+ * before this one.
+ */
+bool
+SharedPlanCacheLookup(CachedPlanSource *plansource, SharedPlanStats *stats,
+					  List **stmt_list)
+{
+	char	   *settings;
+	uint32		keyHash;
+	SharedPlanSet *set;
+	char	   *planstr = NULL;
+	bool		found = false;
+	int			i;
+
+	Assert(SharedPlanCache != NULL);
+
+	if (plansource->search_path == NULL)
+		return false;
+
+	settings = SharedPlanSettingsString();
+	keyHash = SharedPlanKeyHash(plansource, settings);
+	set = SharedPlanCacheGetSet(keyHash);
+
+	LWLockAcquire(&SharedPlanCache->lock, LW_SHARED);
+
+	for (i = 0; i < SHARED_PLAN_WAYS; i++)
+	{
+		SharedPlanSlot *slot = &set->slots[i];
+
+		if (!SharedPlanSlotMatches(slot, plansource, settings, keyHash))
+			continue;
+
+		*stats = slot->stats;
+		if (stmt_list)
+		{
+			planstr = palloc(slot->planlen + 1);
+			memcpy(planstr,
+				   slot->data.data + (slot->num_params + slot->num_schemas) *
+				   sizeof(Oid) + slot->settingslen + 1 + slot->textlen + 1,
+				   slot->planlen + 1);
+		}
+
+		/* same harmless race as in sharedcatcache.c */
+		slot->recent = true;
+		found = true;
+		break;
+	}
+
+	LWLockRelease(&SharedPlanCache->lock);
+
+	pfree(settings);
+
+	if (planstr)
+	{
+		*stmt_list = (List *) stringToNode(planstr);
+		pfree(planstr);
+	}
+
+	return found;
+}
+
+/*
+ * SharedPlanCacheInsert
+ *		Publish a generic plan just built for the given plan source.
+ *
+ * The plan source's current planning statistics are published along with
+ * it.  Nothing is stored if the plan can't be shared, or if entries have
+ * been invalidated since the caller obtained 'generation' from
+ * SharedPlanCacheGeneration, since the plan might then be out of date
+ * already.
+ */
+void
+SharedPlanCacheInsert(CachedPlanSource *plansource, List *stmt_list,
+					  uint64 generation)
+{
+	OverrideSearchPath *path = plansource->search_path;
+	List	   *relationOids = NIL;
+	List	   *invalItems = NIL;
+	char	   *planstr;
+	char	   *settings;
+	Size		settingslen;
+	Size		textlen;
+	Size		planlen;
+	Size		needed;
+	uint32		keyHash;
+	SharedPlanSet *set;
+	SharedPlanSlot *victim = NULL;
+	char	   *data;
+	ListCell   *lc;
+	int			i;
+
+	Assert(SharedPlanCache != NULL);
+
+	if (path == NULL)
+		return;
+
+	foreach(lc, stmt_list)
+	{
+		PlannedStmt *plannedstmt = (PlannedStmt *) lfirst(lc);
+
+		if (!IsA(plannedstmt, PlannedStmt) ||
+			plannedstmt->utilityStmt != NULL ||
+			plannedstmt->transientPlan ||
+			plannedstmt->hasRowSecurity)
+			return;
+
+		relationOids = list_concat_unique_oid(relationOids,
+											  plannedstmt->relationOids);
+		invalItems = list_concat(invalItems,
+								 list_copy(plannedstmt->invalItems));
+	}
+
+	if (list_length(relationOids) > SHARED_PLAN_MAX_RELS ||
+		list_length(invalItems) > SHARED_PLAN_MAX_ITEMS)
+		return;
+
+	planstr = nodeToString(stmt_list);
+
+	/* node names are never quoted, so this can't match inside a token */
+	if (strstr(planstr, "{CUSTOMSCAN ") != NULL ||
+		strstr(planstr, "{FOREIGNSCAN ") != NULL)
+		return;
+
+	settings = SharedPlanSettingsString();
+	settingslen = strlen(settings);
+	textlen = strlen(plansource->query_string);
+	planlen = strlen(planstr);
+	needed = (plansource->num_params + list_length(path->schemas)) * sizeof(Oid) +
+		settingslen + 1 + textlen + 1 + planlen + 1;
+	if (needed > SHARED_PLAN_DATA_SIZE)
+		return;
+
+	keyHash = SharedPlanKeyHash(plansource, settings);
+	set = SharedPlanCacheGetSet(keyHash);
+
+	LWLockAcquire(&SharedPlanCache->lock, LW_EXCLUSIVE);
+
+	if (SharedPlanCache->generation != generation)
+	{
+		LWLockRelease(&SharedPlanCache->lock);
+		return;
+	}
+
+	for (i = 0; i < SHARED_PLAN_WAYS; i++)
+	{
+		SharedPlanSlot *slot = &set->slots[i];
+
+		if (SharedPlanSlotMatches(slot, plansource, settings, keyHash))
+		{
+			victim = slot;
+			break;
+		}
+		if (!slot->inuse && victim == NULL)
+			victim = slot;
+	}
+
+	while (victim == NULL)
+	{
+		SharedPlanSlot *slot = &set->slots[set->hand];
+
+		set->hand = (set->hand + 1) % SHARED_PLAN_WAYS;
+		if (slot->recent)
+			slot->recent = false;
+		else
+			victim = slot;
+	}
+
+	victim->inuse = true;
+	victim->recent = true;
+	victim->dbId = MyDatabaseId;
+	victim->roleId = GetUserId();
+	victim->keyHash = keyHash;
+	victim->cursor_options = plansource->cursor_options;
+	victim->num_params = plansource->num_params;
+	victim->num_schemas = list_length(path->schemas);
+	victim->addCatalog = path->addCatalog;
+	victim->addTemp = path->addTemp;
+	victim->settingslen = (int) settingslen;
+	victim->textlen = (int) textlen;
+	victim->planlen = (int) planlen;
+	victim->stats.generic_cost = plansource->generic_cost;
+	victim->stats.total_custom_cost = plansource->total_custom_cost;
+	victim->stats.num_custom_plans = plansource->num_custom_plans;
+
+	victim->nrels = 0;
+	foreach(lc, relationOids)
+		victim->relationOids[victim->nrels++] = lfirst_oid(lc);
+	victim->nitems = 0;
+	foreach(lc, invalItems)
+	{
+		PlanInvalItem *item = (PlanInvalItem *) lfirst(lc);
+
+		victim->invalItems[victim->nitems].cacheId = item->cacheId;
+		victim->invalItems[victim->nitems].hashValue = item->hashValue;
+		victim->nitems++;
+	}
+
+	data = victim->data.data;
+	if (plansource->num_params > 0)
+		memcpy(data, plansource->param_types,
+			   plansource->num_params * sizeof(Oid));
+	data += plansource->num_params * sizeof(Oid);
+	foreach(lc, path->schemas)
+	{
+		Oid			schema = lfirst_oid(lc);
+
+		memcpy(data, &schema, sizeof(Oid));
+		data += sizeof(Oid);
+	}
+	memcpy(data, settings, settingslen + 1);
+	data += settingslen + 1;
+	memcpy(data, plansource->query_string, textlen + 1);
+	data += textlen + 1;
+	memcpy(data, planstr, planlen + 1);
+
+	LWLockRelease(&SharedPlanCache->lock);
+
+	pfree(settings);
+	pfree(planstr);
+}
+
+/*
+ * Does an invalidation message concern the shared plan cache?
+ */
+static bool
+SharedPlanMessageIsRelevant(const SharedInvalidationMessage *msg)
+{
+	if (msg->id == SHAREDINVALRELCACHE_ID)
+		return true;
+	if (msg->id >= 0)
+		return (msg->cc.id == PROCOID ||
+				msg->cc.id == NAMESPACEOID ||
+				msg->cc.id == OPEROID ||
+				msg->cc.id == AMOPOPID);
+	return false;
+}
+
+/*
+ * Should the slot be removed because of the given invalidation message?
+ *
+ * This applies the same rules as plancache.c's inval callbacks.
+ */
+static bool
+SharedPlanSlotInvalidatedBy(SharedPlanSlot *slot,
+							const SharedInvalidationMessage *msg)
+{
+	int			i;
+
+	if (msg->id == SHAREDINVALRELCACHE_ID)
+	{
+		if (msg->rc.dbId != InvalidOid && msg->rc.dbId != slot->dbId)
+			return false;
+		if (msg->rc.relId == InvalidOid)
+			return slot->nrels > 0;
+		for (i = 0; i < slot->nrels; i++)
+		{
+			if (slot->relationOids[i] == msg->rc.relId)
+				return true;
+		}
+		return false;
+	}
+
+	Assert(msg->id >= 0);
+
+	if (msg->cc.dbId != InvalidOid && msg->cc.dbId != slot->dbId)
+		return false;
+
+	if (msg->cc.id != PROCOID)
+		return true;
+
+	for (i = 0; i < slot->nitems; i++)
+	{
+		if (slot->invalItems[i].cacheId == msg->cc.id &&
+			(msg->cc.hashValue == 0 ||
+			 slot->invalItems[i].hashValue == msg->cc.hashValue))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * SharedPlanCacheProcessMessages
+ *		Apply invalidation messages about to be sent to the SI queue.
+ */
+void
+SharedPlanCacheProcessMessages(const SharedInvalidationMessage *msgs, int n)
+{
+	int			i;
+	int			first;
+
+	if (SharedPlanCache == NULL)
+		return;
+
+	/* don't take the lock for commits that can't affect any plan */
+	for (first = 0; first < n; first++)
+	{
+		if (SharedPlanMessageIsRelevant(&msgs[first]))
+			break;
+	}
+	if (first >= n)
+		return;
+
+	LWLockAcquire(&SharedPlanCache->lock, LW_EXCLUSIVE);
+
+	for (i = 0; i < SharedPlanCache->nsets; i++)
+	{
+		SharedPlanSet *set = &SharedPlanCache->sets[i];
+		int			j;
+
+		for (j = 0; j < SHARED_PLAN_WAYS; j++)
+		{
+			SharedPlanSlot *slot = &set->slots[j];
+			int			k;
+
+			if (!slot->inuse)
+				continue;
+
+			for (k = first; k < n; k++)
+			{
+				if (SharedPlanMessageIsRelevant(&msgs[k]) &&
+					SharedPlanSlotInvalidatedBy(slot, &msgs[k]))
+				{
+					slot->inuse = false;
+					break;
+				}
+			}
+		}
+	}
+
+	/* even if nothing was found, a concurrent planner must not store it */
+	SharedPlanCache->generation++;
+
+	LWLockRelease(&SharedPlanCache->lock);
+}
+
+/*
+ * SharedPlanCacheInvalidateDatabase
+ *		Remove all plans belonging to the given database.
+ */
+void
+SharedPlanCacheInvalidateDatabase(Oid dbId)
+{
+	int			i;
+
+	if (SharedPlanCache == NULL)
+		return;
+
+	LWLockAcquire(&SharedPlanCache->lock, LW_EXCLUSIVE);
+
+	for (i = 0; i < SharedPlanCache->nsets; i++)
+	{
+		SharedPlanSet *set = &SharedPlanCache->sets[i];
+		int			j;
+
+		for (j = 0; j < SHARED_PLAN_WAYS; j++)
+		{
+			if (set->slots[j].dbId == dbId)
+				set->slots[j].inuse = false;
+		}
+	}
+
+	SharedPlanCache->generation++;
+
+	LWLockRelease(&SharedPlanCache->lock);
+}
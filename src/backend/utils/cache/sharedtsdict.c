@@ -0,0 +1,289 @@
+/*-------------------------------------------------------------------------
+ *
+ * sharedtsdict.c
+ *	  Shared-memory copies of text search dictionaries.
+ *
+ * Loading a large Ispell or Hunspell dictionary means reading and sorting
+ * its word list and affix files, which can take a second or more, and the
+ * result takes tens of megabytes in every backend that uses it.  When
+ * shared_ts_dictionary_size is set, ts_cache.c asks us first, and we build
+ * the data of dictionaries of the ispell and synonym templates just once,
+ * in shared memory, where the backends of a database all use the same
+ * copy.
+ *
+ * To build a dictionary, its init method simply runs with a fixed bump
+ * context (see bump.c) laid out in the free part of our shared area as
+ * CurrentMemoryContext, so that everything it pallocs lands there;
+ * afterwards the free part starts behind whatever it used.  This works
+ * because the main shared memory segment is mapped at the same address in
+ * all backends, so that the pointers within the data are valid everywhere,
+ * and because the lexize methods of these templates never modify their
+ * data.  A dictionary that doesn't fit, or that its template can't build
+ * in shared memory (Ispell affixes needing a full regular expression, which
+ * the regex library keeps in malloc'd memory, see spell.c), is loaded
+ * privately instead, as without this module; we remember that, so that
+ * only the first backend tries.
+ *
+ * An entry is identified by the database, the dictionary OID and the xmin
+ * of the dictionary's pg_ts_dict row, so that after ALTER TEXT SEARCH
+ * DICTIONARY backends build a new copy.  Space is never reclaimed: copies
+ * of dropped or altered dictionaries stay around until server restart, as
+ * do copies built from dictionary files that have changed since.
+ *
+ * A single LWLock protects the directory of entries.  It is also held while
+ * a dictionary is built, so that other backends needing a dictionary at the
+ * same time wait for the copy rather than building their own.
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * IDENTIFICATION
+ *	  src/backend/utils/cache/sharedtsdict.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/htup_details.h"
+#include "fmgr.h"
+#include "miscadmin.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/fmgroids.h"
+#include "utils/memutils.h"
+#include "utils/sharedtsdict.h"
+
+
+/* Most dictionaries the directory can hold */
+#define SHARED_TS_MAX_DICTS		64
+
+/* Don't bother building a dictionary in less space than this */
+#define SHARED_TS_MIN_SPACE		(64 * 1024)
+
+typedef struct SharedTSDictEntry
+{
+	Oid			dbId;			/* database the dictionary belongs to */
+	Oid			dictId;			/* OID of the dictionary */
+	TransactionId xmin;			/* xmin of its pg_ts_dict row */
+	void	   *dictData;		/* data built by init method, or NULL if
+								 * the dictionary must be loaded privately */
+} SharedTSDictEntry;
+
+typedef struct SharedTSDictCtl
+{
+	LWLock		lock;			/* protects all of the below */
+	int			tranche_id;
+	LWLockTranche tranche;
+	int			ndicts;			/* number of valid entries in dicts[] */
+	SharedTSDictEntry dicts[SHARED_TS_MAX_DICTS];
+	Size		areasize;		/* size of area[] */
+	Size		used;			/* bytes at start of area[] in use */
+	char	   *area;			/* space for dictionary data */
+} SharedTSDictCtl;
+
+/* GUC variable */
+int			shared_ts_dictionary_size = 0;
+
+bool		SharedTSDictBuilding = false;
+
+/* Pointer to shared state, or NULL if shared dictionaries are disabled */
+static SharedTSDictCtl *SharedTSDict = NULL;
+
+
+/*
+ * Size of the area for dictionary data, or 0 if disabled.
+ */
+static Size
+SharedTSDictAreaSize(void)
+{
+#ifdef EXEC_BACKEND
+
+	/*
+	 * The data contains pointers to static data of the backend executable,
+	 * such as the bump context's method table, which we can't be sure to
+	 * find at the same address in every backend.
+	 */
+	return 0;
+#else
+	if (shared_ts_dictionary_size <= 0)
+		return 0;
+
+	return mul_size(shared_ts_dictionary_size, 1024);
+#endif
+}
+
+Size
+SharedTSDictShmemSize(void)
+{
+	Size		areasize = SharedTSDictAreaSize();
+
+	if (areasize == 0)
+		return 0;
+
+	return add_size(MAXALIGN(sizeof(SharedTSDictCtl)), areasize);
+}
+
+void
+SharedTSDictShmemInit(void)
+{
+	bool		found;
+
+	if (SharedTSDictAreaSize() == 0)
+		return;
+
+	SharedTSDict = (SharedTSDictCtl *)
+		ShmemInitStruct("Shared Text Search Dictionaries",
+						SharedTSDictShmemSize(),
+						&found);
+
+	if (!found)
+	{
+		MemSet(SharedTSDict, 0, sizeof(SharedTSDictCtl));
+
+		SharedTSDict->areasize = SharedTSDictAreaSize();
+		SharedTSDict->area = ((char *) SharedTSDict) +
+			MAXALIGN(sizeof(SharedTSDictCtl));
+		SharedTSDict->tranche_id = LWLockNewTrancheId();
+		SharedTSDict->tranche.name = "SharedTSDictionaries";
+		SharedTSDict->tranche.array_base = &SharedTSDict->lock;
+		SharedTSDict->tranche.array_stride = sizeof(LWLock);
+		LWLockInitialize(&SharedTSDict->lock, SharedTSDict->tranche_id);
+	}
+
+	LWLockRegisterTranche(SharedTSDict->tranche_id,
+						  &SharedTSDict->tranche);
+}
+
+/*
+ * Find the directory entry for a dictionary.  Caller must hold the lock.
+ */
+static SharedTSDictEntry *
+SharedTSDictFind(Oid dictId, TransactionId xmin)
+{
+	int			i;
+
+	for (i = 0; i < SharedTSDict->ndicts; i++)
+	{
+		SharedTSDictEntry *entry = &SharedTSDict->dicts[i];
+
+		if (entry->dbId == MyDatabaseId &&
+			entry->dictId == dictId &&
+			TransactionIdEquals(entry->xmin, xmin))
+			return entry;
+	}
+
+	return NULL;
+}
+
+/*
+ * SharedTSDictLoad
+ *		Get the shared copy of a dictionary's data, building it if needed.
+ *
+ * dicttup is the dictionary's pg_ts_dict row, initOid its template's init
+ * method, and dictoptions the options to pass to that.  Returns NULL if
+ * the dictionary must be loaded privately.  Errors in the init method are
+ * thrown as usual.
+ */
+void *
+SharedTSDictLoad(Oid dictId, HeapTuple dicttup, Oid initOid,
+				 List *dictoptions)
+{
+	TransactionId xmin = HeapTupleHeaderGetRawXmin(dicttup->t_data);
+	SharedTSDictEntry *entry;
+	MemoryContext oldcontext = CurrentMemoryContext;
+	MemoryContext dictcxt;
+	void	   *volatile dictData = NULL;
+
+	if (SharedTSDict == NULL)
+		return NULL;
+
+	/* Only templates whose lexize methods never modify their data */
+	if (initOid != F_DISPELL_INIT && initOid != F_DSYNONYM_INIT)
+		return NULL;
+
+	LWLockAcquire(&SharedTSDict->lock, LW_SHARED);
+	entry = SharedTSDictFind(dictId, xmin);
+	if (entry != NULL)
+		dictData = entry->dictData;
+	LWLockRelease(&SharedTSDict->lock);
+
+	if (entry != NULL)
+		return dictData;
+
+	/*
+	 * Not there, so build it, unless someone else did so while we weren't
+	 * holding the lock.
+	 */
+	LWLockAcquire(&SharedTSDict->lock, LW_EXCLUSIVE);
+
+	entry = SharedTSDictFind(dictId, xmin);
+	if (entry != NULL)
+	{
+		dictData = entry->dictData;
+		LWLockRelease(&SharedTSDict->lock);
+		return dictData;
+	}
+
+	if (SharedTSDict->ndicts >= SHARED_TS_MAX_DICTS ||
+		SharedTSDict->areasize - SharedTSDict->used < SHARED_TS_MIN_SPACE)
+	{
+		LWLockRelease(&SharedTSDict->lock);
+		return NULL;
+	}
+
+	dictcxt = BumpContextCreateFixed(SharedTSDict->area + SharedTSDict->used,
+									 SharedTSDict->areasize - SharedTSDict->used,
+									 "shared text search dictionary");
+
+	PG_TRY();
+	{
+		MemoryContextSwitchTo(dictcxt);
+		SharedTSDictBuilding = true;
+
+		dictData = DatumGetPointer(OidFunctionCall1(initOid,
+											  PointerGetDatum(dictoptions)));
+
+		SharedTSDictBuilding = false;
+		MemoryContextSwitchTo(oldcontext);
+
+		/* Get rid of any private contexts the init method left behind */
+		MemoryContextDeleteChildren(dictcxt);
+		SharedTSDict->used += BumpContextFreeze(dictcxt);
+	}
+	PG_CATCH();
+	{
+		ErrorData  *edata;
+
+		SharedTSDictBuilding = false;
+		MemoryContextSwitchTo(oldcontext);
+		MemoryContextDeleteChildren(dictcxt);
+
+		/*
+		 * Running out of space, or needing something that can't be put in
+		 * shared memory, means that the dictionary must be loaded privately.
+		 * Any other error would happen the same way then, so throw it.
+		 */
+		edata = CopyErrorData();
+		if (edata->sqlerrcode != ERRCODE_OUT_OF_MEMORY &&
+			edata->sqlerrcode != ERRCODE_FEATURE_NOT_SUPPORTED)
+			PG_RE_THROW();
+
+		ereport(DEBUG1,
+				(errmsg_internal("could not build text search dictionary %u in shared memory: %s",
+								 dictId, edata->message)));
+		FlushErrorState();
+		FreeErrorData(edata);
+		dictData = NULL;
+	}
+	PG_END_TRY();
+
+	entry = &SharedTSDict->dicts[SharedTSDict->ndicts++];
+	entry->dbId = MyDatabaseId;
+	entry->dictId = dictId;
+	entry->xmin = xmin;
+	entry->dictData = dictData;
+
+	LWLockRelease(&SharedTSDict->lock);
+
+	return dictData;
+}
@@ -1219,6 +1219,23 @@ GetSysCacheHashValue(int cacheId,
 	return GetCatCacheHashValue(SysCache[cacheId], key1, key2, key3, key4);
 }
 
+/*
+ * GetSysCacheRelationId
+ *
+ * Get the OID of the catalog the specified cache is on, or InvalidOid if
+ * the cache ID is not valid.  This works before InitCatalogCache, and
+ * never throws an error, for the benefit of the shared invalidation queue
+ * code, which uses it while holding its locks.
+ */
+Oid
+GetSysCacheRelationId(int cacheId)
+{
+	if (cacheId < 0 || cacheId >= SysCacheSize)
+		return InvalidOid;
+
+	return cacheinfo[cacheId].reloid;
+}
+
 /*
  * List-search interface
  */
@@ -45,6 +45,7 @@
 #include "utils/inval.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
+#include "utils/sharedtsdict.h"
 #include "utils/syscache.h"
 #include "utils/tqual.h"
 
@@ -333,8 +334,13 @@ lookup_ts_dictionary_cache(Oid dictId)
 			else
 				dictoptions = deserialize_deflist(opt);
 
-			entry->dictData =
-				DatumGetPointer(OidFunctionCall1(template->tmplinit,
+			/* Use the shared copy of the dictionary, if there can be one */
+			entry->dictData = SharedTSDictLoad(dictId, tpdict,
+											   template->tmplinit,
+											   dictoptions);
+			if (entry->dictData == NULL)
+				entry->dictData =
+					DatumGetPointer(OidFunctionCall1(template->tmplinit,
 											  PointerGetDatum(dictoptions)));
 
 			MemoryContextSwitchTo(oldcontext);
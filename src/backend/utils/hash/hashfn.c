@@ -17,6 +17,9 @@
  *	  to poor performance of hash tables.  In most cases a hash
  *	  function should use hash_any() or its variant hash_uint32().
  *
+ *	  dynahash tables are never stored on disk, so the functions here use
+ *	  hash_any_fast() where that helps.
+ *
  *-------------------------------------------------------------------------
  */
 #include "postgres.h"
@@ -40,8 +43,8 @@ string_hash(const void *key, Size keysize)
 	Size		s_len = strlen((const char *) key);
 
 	s_len = Min(s_len, keysize - 1);
-	return DatumGetUInt32(hash_any((const unsigned char *) key,
-								   (int) s_len));
+	return DatumGetUInt32(hash_any_fast((const unsigned char *) key,
+										(int) s_len));
 }
 
 /*
@@ -50,8 +53,8 @@ string_hash(const void *key, Size keysize)
 uint32
 tag_hash(const void *key, Size keysize)
 {
-	return DatumGetUInt32(hash_any((const unsigned char *) key,
-								   (int) keysize));
+	return DatumGetUInt32(hash_any_fast((const unsigned char *) key,
+										(int) keysize));
 }
 
 /*
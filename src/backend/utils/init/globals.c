@@ -108,6 +108,7 @@ bool		enableFsync = true;
 bool		allowSystemTableMods = false;
 int			work_mem = 1024;
 int			maintenance_work_mem = 16384;
+int			max_parallel_maintenance_workers = 0;
 
 /*
  * Primary determinants of sizes of shared-memory structures.
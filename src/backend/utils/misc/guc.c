@@ -26,17 +26,29 @@
 #include <syslog.h>
 #endif
 
+#include "access/clog.h"
 #include "access/commit_ts.h"
 #include "access/gin.h"
+#include "access/heapam.h"
+#include "access/multixact.h"
+#include "access/slru.h"
+#include "access/subtrans.h"
 #include "access/transam.h"
+#include "access/tuptoaster.h"
 #include "access/twophase.h"
 #include "access/xact.h"
+#include "access/xlogprefetch.h"
+#include "access/xlogredoworker.h"
 #include "catalog/namespace.h"
 #include "commands/async.h"
+#include "commands/dbcommands.h"
 #include "commands/prepare.h"
+#include "commands/sequence.h"
 #include "commands/vacuum.h"
 #include "commands/variable.h"
 #include "commands/trigger.h"
+#include "executor/nodeHashjoin.h"
+#include "executor/nodeNestloop.h"
 #include "funcapi.h"
 #include "libpq/auth.h"
 #include "libpq/be-fsstubs.h"
@@ -57,22 +69,28 @@
 #include "postmaster/bgwriter.h"
 #include "postmaster/postmaster.h"
 #include "postmaster/syslogger.h"
+#include "postmaster/walsummarizer.h"
 #include "postmaster/walwriter.h"
+#include "replication/reorderbuffer.h"
 #include "replication/slot.h"
 #include "replication/syncrep.h"
 #include "replication/walreceiver.h"
 #include "replication/walsender.h"
 #include "storage/bufmgr.h"
+#include "storage/buffile.h"
 #include "storage/dsm_impl.h"
 #include "storage/standby.h"
 #include "storage/fd.h"
 #include "storage/pg_shmem.h"
 #include "storage/proc.h"
 #include "storage/predicate.h"
+#include "storage/sinvaladt.h"
+#include "storage/smgr.h"
 #include "tcop/tcopprot.h"
 #include "tsearch/ts_cache.h"
 #include "utils/builtins.h"
 #include "utils/bytea.h"
+#include "utils/catcache.h"
 #include "utils/guc_tables.h"
 #include "utils/memutils.h"
 #include "utils/pg_locale.h"
@@ -80,6 +98,9 @@
 #include "utils/portal.h"
 #include "utils/ps_status.h"
 #include "utils/rls.h"
+#include "utils/sharedcatcache.h"
+#include "utils/sharedplancache.h"
+#include "utils/sharedtsdict.h"
 #include "utils/snapmgr.h"
 #include "utils/tzparser.h"
 #include "utils/xml.h"
@@ -154,6 +175,7 @@ static void assign_syslog_facility(int newval, void *extra);
 static void assign_syslog_ident(const char *newval, void *extra);
 static void assign_session_replication_role(int newval, void *extra);
 static bool check_temp_buffers(int *newval, void **extra, GucSource source);
+static bool check_slru_buffers(int *newval, void **extra, GucSource source);
 static bool check_bonjour(bool *newval, void **extra, GucSource source);
 static bool check_ssl(bool *newval, void **extra, GucSource source);
 static bool check_stage_log_stats(bool *newval, void **extra, GucSource source);
@@ -174,6 +196,7 @@ static bool check_max_worker_processes(int *newval, void **extra, GucSource sour
 static bool check_autovacuum_max_workers(int *newval, void **extra, GucSource source);
 static bool check_autovacuum_work_mem(int *newval, void **extra, GucSource source);
 static bool check_effective_io_concurrency(int *newval, void **extra, GucSource source);
+static bool check_data_direct_io(bool *newval, void **extra, GucSource source);
 static void assign_effective_io_concurrency(int newval, void *extra);
 static void assign_pgstat_temp_directory(const char *newval, void *extra);
 static bool check_application_name(char **newval, void **extra, GucSource source);
@@ -375,6 +398,16 @@ static const struct config_enum_entry huge_pages_options[] = {
 	{NULL, 0, false}
 };
 
+static const struct config_enum_entry numa_buffers_options[] = {
+	{"off", NUMA_BUFFERS_OFF, false},
+	{"interleave", NUMA_BUFFERS_INTERLEAVE, false},
+	{"partition", NUMA_BUFFERS_PARTITION, false},
+	{"false", NUMA_BUFFERS_OFF, true},
+	{"no", NUMA_BUFFERS_OFF, true},
+	{"0", NUMA_BUFFERS_OFF, true},
+	{NULL, 0, false}
+};
+
 /*
  * Although only "on", "off", and "force" are documented, we
  * accept all the likely variants of "on" and "off".
@@ -392,11 +425,27 @@ static const struct config_enum_entry row_security_options[] = {
 	{NULL, 0, false}
 };
 
+static const struct config_enum_entry plan_cache_mode_options[] = {
+	{"auto", PLAN_CACHE_MODE_AUTO, false},
+	{"force_generic_plan", PLAN_CACHE_MODE_FORCE_GENERIC_PLAN, false},
+	{"force_custom_plan", PLAN_CACHE_MODE_FORCE_CUSTOM_PLAN, false},
+	{NULL, 0, false}
+};
+
+static const struct config_enum_entry geqo_strategy_options[] = {
+	{"genetic", GEQO_STRATEGY_GENETIC, false},
+	{"greedy", GEQO_STRATEGY_GREEDY, false},
+	{NULL, 0, false}
+};
+
 /*
  * Options for enum values stored in other modules
  */
 extern const struct config_enum_entry wal_level_options[];
 extern const struct config_enum_entry archive_mode_options[];
+extern const struct config_enum_entry wal_compression_options[];
+extern const struct config_enum_entry default_toast_compression_options[];
+extern const struct config_enum_entry temp_file_compression_options[];
 extern const struct config_enum_entry sync_method_options[];
 extern const struct config_enum_entry dynamic_shared_memory_options[];
 
@@ -823,6 +872,15 @@ static struct config_bool ConfigureNamesBool[] =
 		true,
 		NULL, NULL, NULL
 	},
+	{
+		{"enable_incrementalsort", PGC_USERSET, QUERY_TUNING_METHOD,
+			gettext_noop("Enables the planner's use of incremental sort steps."),
+			NULL
+		},
+		&enable_incrementalsort,
+		true,
+		NULL, NULL, NULL
+	},
 	{
 		{"enable_hashagg", PGC_USERSET, QUERY_TUNING_METHOD,
 			gettext_noop("Enables the planner's use of hashed aggregation plans."),
@@ -841,6 +899,15 @@ static struct config_bool ConfigureNamesBool[] =
 		true,
 		NULL, NULL, NULL
 	},
+	{
+		{"enable_memoize", PGC_USERSET, QUERY_TUNING_METHOD,
+			gettext_noop("Enables the planner's use of memoization of nested-loop inner results."),
+			NULL
+		},
+		&enable_memoize,
+		true,
+		NULL, NULL, NULL
+	},
 	{
 		{"enable_nestloop", PGC_USERSET, QUERY_TUNING_METHOD,
 			gettext_noop("Enables the planner's use of nested-loop join plans."),
@@ -850,6 +917,16 @@ static struct config_bool ConfigureNamesBool[] =
 		true,
 		NULL, NULL, NULL
 	},
+	{
+		{"enable_adaptive_join", PGC_USERSET, QUERY_TUNING_METHOD,
+			gettext_noop("Enables nested-loop joins to switch to hash joins at run time."),
+			gettext_noop("A nested loop switches once it has read many more "
+						 "outer rows than the planner estimated.")
+		},
+		&enable_adaptive_join,
+		true,
+		NULL, NULL, NULL
+	},
 	{
 		{"enable_mergejoin", PGC_USERSET, QUERY_TUNING_METHOD,
 			gettext_noop("Enables the planner's use of merge join plans."),
@@ -868,6 +945,33 @@ static struct config_bool ConfigureNamesBool[] =
 		true,
 		NULL, NULL, NULL
 	},
+	{
+		{"enable_hashjoin_filter", PGC_USERSET, QUERY_TUNING_METHOD,
+			gettext_noop("Enables pushing Bloom filters of hash join keys down to the outer scan."),
+			NULL
+		},
+		&enable_hashjoin_filter,
+		true,
+		NULL, NULL, NULL
+	},
+	{
+		{"enable_parallel_hash", PGC_USERSET, QUERY_TUNING_METHOD,
+			gettext_noop("Enables the planner's use of shared hash tables in parallel hash joins."),
+			NULL
+		},
+		&enable_parallel_hash,
+		true,
+		NULL, NULL, NULL
+	},
+	{
+		{"enable_partitionwise_aggregate", PGC_USERSET, QUERY_TUNING_METHOD,
+			gettext_noop("Enables grouping each member of an inheritance tree separately."),
+			NULL
+		},
+		&enable_partitionwise_aggregate,
+		false,
+		NULL, NULL, NULL
+	},
 	{
 		{"geqo", PGC_USERSET, QUERY_TUNING_GEQO,
 			gettext_noop("Enables genetic query optimization."),
@@ -937,6 +1041,16 @@ static struct config_bool ConfigureNamesBool[] =
 		true,
 		NULL, NULL, NULL
 	},
+	{
+		{"data_direct_io", PGC_POSTMASTER, RESOURCES_DISK,
+			gettext_noop("Bypasses the operating system's cache when reading and writing data files."),
+			gettext_noop("Relation data files are opened with O_DIRECT, so that pages are not held "
+						 "both in shared buffers and in the kernel's page cache.")
+		},
+		&data_direct_io,
+		false,
+		check_data_direct_io, NULL, NULL
+	},
 	{
 		{"ignore_checksum_failure", PGC_SUSET, DEVELOPER_OPTIONS,
 			gettext_noop("Continues processing after a checksum failure."),
@@ -991,11 +1105,11 @@ static struct config_bool ConfigureNamesBool[] =
 	},
 
 	{
-		{"wal_compression", PGC_USERSET, WAL_SETTINGS,
-			gettext_noop("Compresses full-page writes written in WAL file."),
+		{"summarize_wal", PGC_SIGHUP, WAL_SETTINGS,
+			gettext_noop("Starts the WAL summarizer process, to speed up incremental base backups."),
 			NULL
 		},
-		&wal_compression,
+		&summarize_wal,
 		false,
 		NULL, NULL, NULL
 	},
@@ -1214,6 +1328,30 @@ static struct config_bool ConfigureNamesBool[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"analyze_full_ndistinct", PGC_USERSET, QUERY_TUNING_OTHER,
+			gettext_noop("Makes ANALYZE scan whole tables to count distinct values."),
+			gettext_noop("The number of distinct values in each column is "
+						 "estimated from all rows, rather than from the "
+						 "sample used for the other statistics.")
+		},
+		&analyze_full_ndistinct,
+		false,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"defer_heap_pruning", PGC_USERSET, AUTOVACUUM,
+			gettext_noop("Leaves opportunistic pruning of heap pages to autovacuum."),
+			gettext_noop("Queries that come across a page in need of pruning "
+						 "ask an autovacuum worker to prune it, rather than "
+						 "doing it themselves.")
+		},
+		&defer_heap_pruning,
+		false,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"trace_notify", PGC_USERSET, DEVELOPER_OPTIONS,
 			gettext_noop("Generates debugging output for LISTEN and NOTIFY."),
@@ -1817,6 +1955,136 @@ static struct config_int ConfigureNamesInt[] =
 		check_temp_buffers, NULL, NULL
 	},
 
+	{
+		{"transaction_buffers", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Sets the number of buffers used to cache the transaction status log."),
+			gettext_noop("0 sizes the cache automatically, based on shared_buffers."),
+			GUC_UNIT_BLOCKS
+		},
+		&transaction_buffers,
+		0, 0, SLRU_MAX_BUFFERS,
+		check_slru_buffers, NULL, NULL
+	},
+
+	{
+		{"commit_timestamp_buffers", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Sets the number of buffers used to cache the commit timestamp log."),
+			gettext_noop("0 sizes the cache automatically, based on shared_buffers."),
+			GUC_UNIT_BLOCKS
+		},
+		&commit_timestamp_buffers,
+		0, 0, SLRU_MAX_BUFFERS,
+		check_slru_buffers, NULL, NULL
+	},
+
+	{
+		{"subtransaction_buffers", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Sets the number of buffers used to cache the subtransaction log."),
+			NULL,
+			GUC_UNIT_BLOCKS
+		},
+		&subtransaction_buffers,
+		32, SLRU_MIN_BUFFERS, SLRU_MAX_BUFFERS,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"multixact_offset_buffers", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Sets the number of buffers used to cache the MultiXact offset log."),
+			NULL,
+			GUC_UNIT_BLOCKS
+		},
+		&multixact_offset_buffers,
+		8, SLRU_MIN_BUFFERS, SLRU_MAX_BUFFERS,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"multixact_member_buffers", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Sets the number of buffers used to cache the MultiXact member log."),
+			NULL,
+			GUC_UNIT_BLOCKS
+		},
+		&multixact_member_buffers,
+		16, SLRU_MIN_BUFFERS, SLRU_MAX_BUFFERS,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"notify_buffers", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Sets the number of buffers used to cache the LISTEN/NOTIFY message queue."),
+			NULL,
+			GUC_UNIT_BLOCKS
+		},
+		&notify_buffers,
+		8, SLRU_MIN_BUFFERS, SLRU_MAX_BUFFERS,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"shared_catcache_size", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Sets the amount of shared memory used to share catalog tuples between sessions."),
+			gettext_noop("Zero disables the shared catalog cache."),
+			GUC_UNIT_KB
+		},
+		&shared_catcache_size,
+		0, 0, MAX_KILOBYTES,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"shared_plan_cache_size", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Sets the amount of shared memory used to share generic plans between sessions."),
+			gettext_noop("Zero disables the shared plan cache."),
+			GUC_UNIT_KB
+		},
+		&shared_plan_cache_size,
+		0, 0, MAX_KILOBYTES,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"shared_ts_dictionary_size", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Sets the amount of shared memory used to share text search dictionaries between sessions."),
+			gettext_noop("Zero disables shared text search dictionaries."),
+			GUC_UNIT_KB
+		},
+		&shared_ts_dictionary_size,
+		0, 0, MAX_KILOBYTES,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"catalog_cache_limit", PGC_USERSET, RESOURCES_MEM,
+			gettext_noop("Sets the maximum memory to be used for each session's catalog cache."),
+			gettext_noop("Zero means no limit."),
+			GUC_UNIT_KB
+		},
+		&catalog_cache_limit,
+		0, 0, MAX_KILOBYTES,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"relation_cache_limit", PGC_USERSET, RESOURCES_MEM,
+			gettext_noop("Sets the maximum number of relations kept in each session's relation cache."),
+			gettext_noop("Zero means no limit.")
+		},
+		&relation_cache_limit,
+		0, 0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"shared_invalidation_queue_size", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Sets the number of cache invalidation messages the shared invalidation queue can hold."),
+			gettext_noop("The value is rounded up to a power of 2.")
+		},
+		&shared_invalidation_queue_size,
+		4096, 1024, 1048576,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"port", PGC_POSTMASTER, CONN_AUTH_SETTINGS,
 			gettext_noop("Sets the TCP port the server listens on."),
@@ -1880,6 +2148,19 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"logical_decoding_work_mem", PGC_USERSET, RESOURCES_MEM,
+			gettext_noop("Sets the maximum memory to be used for logical decoding."),
+			gettext_noop("This much memory can be used by the changes of all "
+						 "transactions being decoded before the largest one "
+						 "is streamed or written to disk."),
+			GUC_UNIT_KB
+		},
+		&logical_decoding_work_mem,
+		65536, 64, MAX_KILOBYTES,
+		NULL, NULL, NULL
+	},
+
 	/*
 	 * We use the hopefully-safely-small value of 100kB as the compiled-in
 	 * default for max_stack_depth.  InitializeGUCOptions will increase it if
@@ -1907,6 +2188,17 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"temp_file_write_behind", PGC_USERSET, RESOURCES_DISK,
+			gettext_noop("Sets the size of the buffer collecting writes to sort and tuplestore temporary files."),
+			gettext_noop("Values smaller than two blocks disable write-behind."),
+			GUC_UNIT_KB
+		},
+		&temp_file_write_behind,
+		128, 0, 1048576,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"vacuum_cost_page_hit", PGC_USERSET, RESOURCES_VACUUM_DELAY,
 			gettext_noop("Vacuum cost for a page found in the buffer cache."),
@@ -2124,6 +2416,29 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"max_pred_locks_per_relation", PGC_SIGHUP, LOCK_MANAGEMENT,
+			gettext_noop("Sets the maximum number of predicate-locked pages and tuples per relation."),
+			gettext_noop("If more than this total of pages and tuples in the same relation are locked "
+						 "by a connection, those locks are replaced by a relation-level lock.  "
+						 "Negative values divide max_pred_locks_per_transaction by their absolute value.")
+		},
+		&max_predicate_locks_per_relation,
+		-2, -INT_MAX, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"max_pred_locks_per_page", PGC_SIGHUP, LOCK_MANAGEMENT,
+			gettext_noop("Sets the maximum number of predicate-locked tuples per page."),
+			gettext_noop("If more than this number of tuples on the same page are locked "
+						 "by a connection, those locks are replaced by a page-level lock.")
+		},
+		&max_predicate_locks_per_page,
+		2, 0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"authentication_timeout", PGC_SIGHUP, CONN_AUTH_SECURITY,
 			gettext_noop("Sets the maximum allowed time to complete client authentication."),
@@ -2204,6 +2519,17 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"checkpoint_flush_after", PGC_SIGHUP, WAL_CHECKPOINTS,
+			gettext_noop("Number of pages after which previously performed writes are flushed to disk."),
+			NULL,
+			GUC_UNIT_BLOCKS
+		},
+		&checkpoint_flush_after,
+		DEFAULT_CHECKPOINT_FLUSH_AFTER, 0, WRITEBACK_MAX_PENDING_FLUSHES,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"wal_buffers", PGC_POSTMASTER, WAL_SETTINGS,
 			gettext_noop("Sets the number of disk-page buffers in shared memory for WAL."),
@@ -2215,6 +2541,16 @@ static struct config_int ConfigureNamesInt[] =
 		check_wal_buffers, NULL, NULL
 	},
 
+	{
+		{"wal_insert_locks", PGC_POSTMASTER, WAL_SETTINGS,
+			gettext_noop("Sets the number of locks used for concurrent WAL insertion."),
+			NULL
+		},
+		&wal_insert_locks,
+		8, 1, 1024,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"wal_writer_delay", PGC_SIGHUP, WAL_SETTINGS,
 			gettext_noop("WAL writer sleep time between WAL flushes."),
@@ -2226,6 +2562,28 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"wal_writer_flush_after", PGC_SIGHUP, WAL_SETTINGS,
+			gettext_noop("Amount of WAL after which the WAL writer writes and flushes it."),
+			gettext_noop("0 disables writing WAL ahead in aligned units."),
+			GUC_UNIT_XBLOCKS
+		},
+		&WalWriterFlushAfter,
+		128, 0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"wal_summary_keep_time", PGC_SIGHUP, WAL_SETTINGS,
+			gettext_noop("Time for which WAL summary files are kept."),
+			gettext_noop("Zero keeps them forever."),
+			GUC_UNIT_MIN
+		},
+		&wal_summary_keep_time,
+		10 * 24 * 60, 0, INT_MAX / 60,
+		NULL, NULL, NULL
+	},
+
 	{
 		/* see max_connections */
 		{"max_wal_senders", PGC_POSTMASTER, REPLICATION_SENDING,
@@ -2263,11 +2621,11 @@ static struct config_int ConfigureNamesInt[] =
 		{"commit_delay", PGC_SUSET, WAL_SETTINGS,
 			gettext_noop("Sets the delay in microseconds between transaction commit and "
 						 "flushing WAL to disk."),
-			NULL
+			gettext_noop("-1 chooses the delay from the measured flush time and rate of commits.")
 			/* we have no microseconds designation, so can't supply units here */
 		},
 		&CommitDelay,
-		0, 0, 100000,
+		0, -1, 100000,
 		NULL, NULL, NULL
 	},
 
@@ -2355,6 +2713,36 @@ static struct config_int ConfigureNamesInt[] =
 		check_effective_io_concurrency, assign_effective_io_concurrency, NULL
 	},
 
+	{
+		{"recovery_prefetch_distance",
+			PGC_SIGHUP,
+			RESOURCES_ASYNCHRONOUS,
+			gettext_noop("Sets how far ahead of replay recovery reads WAL to prefetch referenced blocks."),
+			gettext_noop("Zero disables prefetching during recovery."),
+			GUC_UNIT_KB
+		},
+		&recovery_prefetch_distance,
+#ifdef USE_PREFETCH
+		256, 0, 1024 * 1024,
+#else
+		0, 0, 0,
+#endif
+		NULL, NULL, NULL
+	},
+
+	{
+		{"io_combine_limit",
+			PGC_USERSET,
+			RESOURCES_ASYNCHRONOUS,
+			gettext_noop("Sets the largest number of consecutive blocks sequential scans read at once."),
+			NULL,
+			GUC_UNIT_BLOCKS
+		},
+		&io_combine_limit,
+		DEFAULT_IO_COMBINE_LIMIT, 1, MAX_IO_COMBINE_BLOCKS,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"max_worker_processes",
 			PGC_POSTMASTER,
@@ -2367,6 +2755,26 @@ static struct config_int ConfigureNamesInt[] =
 		check_max_worker_processes, NULL, NULL
 	},
 
+	{
+		{"max_parallel_degree", PGC_USERSET, RESOURCES_ASYNCHRONOUS,
+			gettext_noop("Sets the maximum number of parallel processes per executor node."),
+			NULL
+		},
+		&max_parallel_degree,
+		0, 0, MAX_BACKENDS,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"max_parallel_maintenance_workers", PGC_USERSET, RESOURCES_ASYNCHRONOUS,
+			gettext_noop("Sets the maximum number of parallel processes per maintenance operation."),
+			NULL
+		},
+		&max_parallel_maintenance_workers,
+		0, 0, MAX_BACKENDS,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"log_rotation_age", PGC_SIGHUP, LOGGING_WHERE,
 			gettext_noop("Automatic log file rotation will occur after N minutes."),
@@ -2467,6 +2875,16 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"recovery_workers", PGC_POSTMASTER, REPLICATION_STANDBY,
+			gettext_noop("Sets the number of background workers that apply WAL during recovery."),
+			gettext_noop("Zero means that the startup process applies all WAL itself.")
+		},
+		&recovery_workers,
+		0, 0, MAX_BACKENDS,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"wal_segment_size", PGC_INTERNAL, PRESET_OPTIONS,
 			gettext_noop("Shows the number of pages per write ahead log segment."),
@@ -2669,6 +3087,30 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"sequence_shared_cache", PGC_USERSET, CLIENT_CONN_STATEMENT,
+			gettext_noop("Sets the number of values of sequences without CACHE "
+						 "to set aside in shared memory at a time."),
+			gettext_noop("A value of 0 or 1 turns this off.")
+		},
+		&sequence_shared_cache,
+		0, 0, 1000000,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"create_database_wal_log_limit", PGC_USERSET, CLIENT_CONN_STATEMENT,
+			gettext_noop("Sets the largest template database that CREATE DATABASE "
+						 "copies through the write-ahead log by default."),
+			gettext_noop("Larger templates are copied file by file, which requires "
+						 "checkpoints. -1 means always copy file by file."),
+			GUC_UNIT_KB
+		},
+		&create_database_wal_log_limit,
+		16384, -1, MAX_KILOBYTES,
+		NULL, NULL, NULL
+	},
+
 	/* End-of-list marker */
 	{
 		{NULL, 0, 0, NULL, NULL}, NULL, 0, 0, 0, NULL, NULL, NULL
@@ -2728,6 +3170,26 @@ static struct config_real ConfigureNamesReal[] =
 		DEFAULT_CPU_OPERATOR_COST, 0, DBL_MAX,
 		NULL, NULL, NULL
 	},
+	{
+		{"parallel_tuple_cost", PGC_USERSET, QUERY_TUNING_COST,
+			gettext_noop("Sets the planner's estimate of the cost of "
+				  "passing each tuple (row) from worker to master backend."),
+			NULL
+		},
+		&parallel_tuple_cost,
+		DEFAULT_PARALLEL_TUPLE_COST, 0, DBL_MAX,
+		NULL, NULL, NULL
+	},
+	{
+		{"parallel_setup_cost", PGC_USERSET, QUERY_TUNING_COST,
+			gettext_noop("Sets the planner's estimate of the cost of "
+						 "starting up worker processes for parallel query."),
+			NULL
+		},
+		&parallel_setup_cost,
+		DEFAULT_PARALLEL_SETUP_COST, 0, DBL_MAX,
+		NULL, NULL, NULL
+	},
 
 	{
 		{"cursor_tuple_fraction", PGC_USERSET, QUERY_TUNING_OTHER,
@@ -3321,13 +3783,13 @@ static struct config_string ConfigureNamesString[] =
 
 	{
 		{"synchronous_standby_names", PGC_SIGHUP, REPLICATION_MASTER,
-			gettext_noop("List of names of potential synchronous standbys."),
+			gettext_noop("Number and names of potential synchronous standbys."),
 			NULL,
 			GUC_LIST_INPUT
 		},
 		&SyncRepStandbyNames,
 		"",
-		check_synchronous_standby_names, NULL, NULL
+		check_synchronous_standby_names, assign_synchronous_standby_names, NULL
 	},
 
 	{
@@ -3421,6 +3883,16 @@ static struct config_enum ConfigureNamesEnum[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"default_toast_compression", PGC_USERSET, CLIENT_CONN_STATEMENT,
+			gettext_noop("Sets the default compression method for compressible values."),
+			gettext_noop("Columns can override this with their \"compression\" option.")
+		},
+		&default_toast_compression,
+		TOAST_PGLZ_COMPRESSION, default_toast_compression_options,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"client_min_messages", PGC_USERSET, LOGGING_WHEN,
 			gettext_noop("Sets the message levels that are sent to the client."),
@@ -3432,6 +3904,17 @@ static struct config_enum ConfigureNamesEnum[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"geqo_strategy", PGC_USERSET, QUERY_TUNING_GEQO,
+			gettext_noop("GEQO: selects the algorithm used to search for a join order."),
+			gettext_noop("\"greedy\" is much faster than \"genetic\" and always "
+						 "chooses the same plan for the same query.")
+		},
+		&geqo_strategy,
+		GEQO_STRATEGY_GENETIC, geqo_strategy_options,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"constraint_exclusion", PGC_USERSET, QUERY_TUNING_OTHER,
 			gettext_noop("Enables the planner to use constraints to optimize queries."),
@@ -3443,6 +3926,18 @@ static struct config_enum ConfigureNamesEnum[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"plan_cache_mode", PGC_USERSET, QUERY_TUNING_OTHER,
+			gettext_noop("Controls the planner's choice between custom and generic plans for prepared statements."),
+			gettext_noop("Prepared statements can have custom and generic plans, "
+						 "and the planner will attempt to choose which is better.  "
+						 "This can be set to override the default behavior.")
+		},
+		&plan_cache_mode,
+		PLAN_CACHE_MODE_AUTO, plan_cache_mode_options,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"default_transaction_isolation", PGC_USERSET, CLIENT_CONN_STATEMENT,
 			gettext_noop("Sets the transaction isolation level of each new transaction."),
@@ -3587,6 +4082,26 @@ static struct config_enum ConfigureNamesEnum[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"wal_compression", PGC_USERSET, WAL_SETTINGS,
+			gettext_noop("Compresses full-page writes written in WAL file with specified method."),
+			NULL
+		},
+		&wal_compression,
+		WAL_COMPRESSION_NONE, wal_compression_options,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"temp_file_compression", PGC_USERSET, RESOURCES_DISK,
+			gettext_noop("Compresses hash join and hash aggregate temporary files with specified method."),
+			NULL
+		},
+		&temp_file_compression,
+		TEMP_FILE_COMPRESSION_NONE, temp_file_compression_options,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"dynamic_shared_memory_type", PGC_POSTMASTER, RESOURCES_MEM,
 			gettext_noop("Selects the dynamic shared memory implementation used."),
@@ -3638,6 +4153,16 @@ static struct config_enum ConfigureNamesEnum[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"numa_buffers", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Placement of shared buffers on NUMA nodes."),
+			NULL
+		},
+		&numa_buffers,
+		NUMA_BUFFERS_OFF, numa_buffers_options,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"row_security", PGC_USERSET, CONN_AUTH_SECURITY,
 			gettext_noop("Enable row security."),
@@ -4603,6 +5128,31 @@ SelectConfigFiles(const char *userDoption, const char *progname)
 }
 
 
+/*
+ * Has any option been changed by SET (and not RESET since)?
+ *
+ * Options that RESET ALL leaves alone don't count: they are either reset
+ * per transaction anyway, or, like role and session_authorization, better
+ * checked for directly.
+ */
+bool
+SessionOptionsChanged(void)
+{
+	int			i;
+
+	for (i = 0; i < num_guc_variables; i++)
+	{
+		struct config_generic *gconf = guc_variables[i];
+
+		if (gconf->flags & GUC_NO_RESET_ALL)
+			continue;
+		if (gconf->source == PGC_S_SESSION)
+			return true;
+	}
+
+	return false;
+}
+
 /*
  * Reset all options to their saved default values (implements RESET ALL)
  */
@@ -9709,6 +10259,19 @@ check_temp_buffers(int *newval, void **extra, GucSource source)
 	return true;
 }
 
+static bool
+check_slru_buffers(int *newval, void **extra, GucSource source)
+{
+	/* 0 selects automatic sizing; otherwise enforce the SLRU minimum */
+	if (*newval != 0 && *newval < SLRU_MIN_BUFFERS)
+	{
+		GUC_check_errdetail("The value must be 0 or at least %d.",
+							SLRU_MIN_BUFFERS);
+		return false;
+	}
+	return true;
+}
+
 static bool
 check_bonjour(bool *newval, void **extra, GucSource source)
 {
@@ -10016,6 +10579,17 @@ assign_effective_io_concurrency(int newval, void *extra)
 #endif   /* USE_PREFETCH */
 }
 
+static bool
+check_data_direct_io(bool *newval, void **extra, GucSource source)
+{
+	if (*newval && PG_O_DIRECT == 0)
+	{
+		GUC_check_errdetail("Direct I/O is not supported on this platform.");
+		return false;
+	}
+	return true;
+}
+
 static void
 assign_pgstat_temp_directory(const char *newval, void *extra)
 {
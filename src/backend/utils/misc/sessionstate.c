@@ -0,0 +1,114 @@
+/*-------------------------------------------------------------------------
+ *
+ * sessionstate.c
+ *	  Tracking of session state that ties a client to its backend.
+ *
+ * Most of what a client does only lasts until the end of its transaction,
+ * but a few things last for the rest of the session: temporary tables,
+ * prepared statements, holdable cursors, LISTEN registrations, session-level
+ * advisory locks, and settings made with SET.  A connection pooler that
+ * wants to hand a backend from one client to another at transaction
+ * boundaries can only do so safely while none of these exist.  This module
+ * collects that knowledge from the subsystems concerned, so that it can be
+ * checked in one place.
+ *
+ * The checks are made on demand rather than maintained as flags, since the
+ * state can go away again in many ways (DISCARD, DEALLOCATE, UNLISTEN, RESET,
+ * pg_advisory_unlock, ...), and each subsystem already knows whether it has
+ * anything left.
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ * IDENTIFICATION
+ *		  src/backend/utils/misc/sessionstate.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "catalog/namespace.h"
+#include "catalog/pg_type.h"
+#include "commands/async.h"
+#include "commands/prepare.h"
+#include "miscadmin.h"
+#include "storage/lock.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/portal.h"
+#include "utils/sessionstate.h"
+
+
+/* Names reported by pg_session_state(), in flag order */
+static const struct
+{
+	int			flag;
+	const char *name;
+}	session_state_names[] =
+{
+	{SESSION_STATE_TEMP_OBJECTS, "temporary objects"},
+	{SESSION_STATE_PREPARED_STMTS, "prepared statements"},
+	{SESSION_STATE_HOLD_CURSORS, "holdable cursors"},
+	{SESSION_STATE_LISTEN, "listen"},
+	{SESSION_STATE_ADVISORY_LOCKS, "advisory locks"},
+	{SESSION_STATE_SETTINGS, "settings"},
+	{SESSION_STATE_ROLE, "role"}
+};
+
+
+/*
+ * GetSessionState
+ *		Return a bitmask of SESSION_STATE_* flags for the current session.
+ *
+ * Zero means the session carries nothing over from one transaction to the
+ * next, beyond what its user and database imply.  When called inside a
+ * transaction, the answer may include state that the transaction would
+ * discard if it aborted.
+ */
+int
+GetSessionState(void)
+{
+	int			state = 0;
+
+	if (isTempNamespaceInUse())
+		state |= SESSION_STATE_TEMP_OBJECTS;
+	if (HavePreparedStatements())
+		state |= SESSION_STATE_PREPARED_STMTS;
+	if (ThereAreHoldablePortals())
+		state |= SESSION_STATE_HOLD_CURSORS;
+	if (IsListeningOnAnyChannel())
+		state |= SESSION_STATE_LISTEN;
+	if (LockHeldSessionLocks(USER_LOCKMETHOD))
+		state |= SESSION_STATE_ADVISORY_LOCKS;
+	if (SessionOptionsChanged())
+		state |= SESSION_STATE_SETTINGS;
+	if (GetSessionUserId() != GetAuthenticatedUserId() ||
+		GetOuterUserId() != GetSessionUserId())
+		state |= SESSION_STATE_ROLE;
+
+	return state;
+}
+
+/*
+ * SQL-callable function returning the kinds of session state in use, as a
+ * text array.  An empty array means none.
+ */
+Datum
+pg_session_state(PG_FUNCTION_ARGS)
+{
+	int			state = GetSessionState();
+	Datum		elems[lengthof(session_state_names)];
+	int			nelems = 0;
+	int			i;
+
+	for (i = 0; i < lengthof(session_state_names); i++)
+	{
+		if (state & session_state_names[i].flag)
+			elems[nelems++] = CStringGetTextDatum(session_state_names[i].name);
+	}
+
+	PG_RETURN_ARRAYTYPE_P(construct_array(elems, nelems,
+										  TEXTOID, -1, false, 'i'));
+}
@@ -0,0 +1,890 @@
+/*-------------------------------------------------------------------------
+ *
+ * bump.c
+ *	  Bump allocator definitions.
+ *
+ * A bump context is a MemoryContext implementation for short-lived memory
+ * that is released all at once by resetting the context, such as the
+ * per-tuple memory of executor expression contexts.
+ *
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * IDENTIFICATION
+ *	  src/backend/utils/mmgr/bump.c
+ *
+ *
+ * NOTE:
+ *	Allocation just advances a pointer in the current block: requests are
+ *	only rounded up to MAXALIGN, and there are no freelists to search or
+ *	maintain.  Compared to aset.c, whose power-of-2 chunk sizes can waste
+ *	up to half of every request, the live data is packed much more densely,
+ *	which is what matters for memory that is filled and thrown away again
+ *	for every tuple.
+ *
+ *	Each chunk still carries the StandardChunkHeader, and nothing more,
+ *	since pfree(), repalloc() and GetMemoryChunkSpace() find a chunk's
+ *	context through it.  But pfree() does not make the space of a chunk
+ *	reusable, except in the common case of freeing the most recently
+ *	allocated chunk, which simply rewinds the block's free pointer.  Memory
+ *	is otherwise only given back at reset or delete.  Code that needs to
+ *	alloc and free lots of memory without resetting the context should
+ *	therefore not use a bump context.
+ *
+ *	As in aset.c, requests larger than a fraction of the maximum block size
+ *	get a dedicated block, which pfree() does give back to malloc(); and
+ *	the first regular block is kept over resets to avoid malloc thrashing.
+ *
+ *	A "fixed" bump context lives in an area of memory supplied by its
+ *	creator, such as a piece of shared memory, and never calls malloc():
+ *	requests that don't fit in the area fail.
+ *
+ *	About CLOBBER_FREED_MEMORY and MEMORY_CONTEXT_CHECKING: see aset.c.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "utils/memdebug.h"
+#include "utils/memutils.h"
+
+
+/* We allow chunks to be at most 1/8 of maxBlockSize before going solo */
+#define BUMP_CHUNK_FRACTION		8
+
+typedef struct BumpBlockData *BumpBlock;		/* forward reference */
+
+/*
+ * BumpContext is a specialized implementation of MemoryContext.
+ *
+ * The head of the blocks list is the block we're allocating from; dedicated
+ * blocks for large chunks are linked in behind it.
+ */
+typedef struct BumpContext
+{
+	MemoryContextData header;	/* Standard memory-context fields */
+	/* Info about storage allocated in this context: */
+	BumpBlock	blocks;			/* head of list of blocks in this context */
+	BumpBlock	keeper;			/* if not NULL, keep this block over resets */
+	/* Allocation parameters for this context: */
+	Size		initBlockSize;	/* initial block size */
+	Size		maxBlockSize;	/* maximum block size */
+	Size		nextBlockSize;	/* next block size to allocate */
+	Size		allocChunkLimit;	/* effective chunk size limit */
+	bool		fixed;			/* all space is in the creator's area */
+} BumpContext;
+
+typedef BumpContext *Bump;
+
+/*
+ * BumpBlock
+ *		The unit of memory that is obtained by bump.c from malloc().  Its
+ *		chunks are laid out back to back from the header to freeptr.
+ */
+typedef struct BumpBlockData
+{
+	BumpBlock	next;			/* next block in context's blocks list */
+	char	   *freeptr;		/* start of free space in this block */
+	char	   *endptr;			/* end of space in this block */
+} BumpBlockData;
+
+#define BUMP_BLOCKHDRSZ		MAXALIGN(sizeof(BumpBlockData))
+#define BUMP_CHUNKHDRSZ		STANDARDCHUNKHEADERSIZE
+
+#define BumpPointerGetHeader(ptr) \
+	((StandardChunkHeader *) (((char *) (ptr)) - BUMP_CHUNKHDRSZ))
+#define BumpHeaderGetPointer(hdr) \
+	((void *) (((char *) (hdr)) + BUMP_CHUNKHDRSZ))
+
+/*
+ * These functions implement the MemoryContext API for Bump contexts.
+ */
+static void *BumpAlloc(MemoryContext context, Size size);
+static void BumpFree(MemoryContext context, void *pointer);
+static void *BumpRealloc(MemoryContext context, void *pointer, Size size);
+static void BumpInit(MemoryContext context);
+static void BumpReset(MemoryContext context);
+static void BumpDelete(MemoryContext context);
+static Size BumpGetChunkSpace(MemoryContext context, void *pointer);
+static bool BumpIsEmpty(MemoryContext context);
+static void BumpStats(MemoryContext context, int level);
+
+#ifdef MEMORY_CONTEXT_CHECKING
+static void BumpCheck(MemoryContext context);
+#endif
+
+/*
+ * This is the virtual function table for Bump contexts.
+ */
+static MemoryContextMethods BumpMethods = {
+	BumpAlloc,
+	BumpFree,
+	BumpRealloc,
+	BumpInit,
+	BumpReset,
+	BumpDelete,
+	BumpGetChunkSpace,
+	BumpIsEmpty,
+	BumpStats
+#ifdef MEMORY_CONTEXT_CHECKING
+	,BumpCheck
+#endif
+};
+
+#ifdef CLOBBER_FREED_MEMORY
+
+/* Wipe freed memory for debugging purposes */
+static void
+wipe_mem(void *ptr, size_t size)
+{
+	VALGRIND_MAKE_MEM_UNDEFINED(ptr, size);
+	memset(ptr, 0x7F, size);
+	VALGRIND_MAKE_MEM_NOACCESS(ptr, size);
+}
+#endif
+
+#ifdef MEMORY_CONTEXT_CHECKING
+static void
+set_sentinel(void *base, Size offset)
+{
+	char	   *ptr = (char *) base + offset;
+
+	VALGRIND_MAKE_MEM_UNDEFINED(ptr, 1);
+	*ptr = 0x7E;
+	VALGRIND_MAKE_MEM_NOACCESS(ptr, 1);
+}
+
+static bool
+sentinel_ok(const void *base, Size offset)
+{
+	const char *ptr = (const char *) base + offset;
+	bool		ret;
+
+	VALGRIND_MAKE_MEM_DEFINED(ptr, 1);
+	ret = *ptr == 0x7E;
+	VALGRIND_MAKE_MEM_NOACCESS(ptr, 1);
+
+	return ret;
+}
+#endif
+
+#ifdef RANDOMIZE_ALLOCATED_MEMORY
+
+/*
+ * Fill a just-allocated piece of memory with "random" data, as in aset.c.
+ */
+static void
+randomize_mem(char *ptr, size_t size)
+{
+	static int	save_ctr = 1;
+	size_t		remaining = size;
+	int			ctr;
+
+	ctr = save_ctr;
+	VALGRIND_MAKE_MEM_UNDEFINED(ptr, size);
+	while (remaining-- > 0)
+	{
+		*ptr++ = ctr;
+		if (++ctr > 251)
+			ctr = 1;
+	}
+	VALGRIND_MAKE_MEM_UNDEFINED(ptr - size, size);
+	save_ctr = ctr;
+}
+#endif   /* RANDOMIZE_ALLOCATED_MEMORY */
+
+
+/*
+ * Public routines
+ */
+
+
+/*
+ * BumpContextCreate
+ *		Create a new Bump context.
+ *
+ * parent: parent context, or NULL if top-level context
+ * name: name of context (for debugging --- string will be copied)
+ * minContextSize: minimum context size
+ * initBlockSize: initial allocation block size
+ * maxBlockSize: maximum allocation block size
+ *
+ * The parameters have the same meaning as for AllocSetContextCreate, so the
+ * ALLOCSET_* size macros can be used here as well.
+ */
+MemoryContext
+BumpContextCreate(MemoryContext parent,
+				  const char *name,
+				  Size minContextSize,
+				  Size initBlockSize,
+				  Size maxBlockSize)
+{
+	Bump		set;
+
+	/* Do the type-independent part of context creation */
+	set = (Bump) MemoryContextCreate(T_BumpContext,
+									 sizeof(BumpContext),
+									 &BumpMethods,
+									 parent,
+									 name);
+
+	/*
+	 * Make sure alloc parameters are reasonable, and save them.
+	 *
+	 * We somewhat arbitrarily enforce a minimum 1K block size, as aset.c
+	 * does.
+	 */
+	initBlockSize = MAXALIGN(initBlockSize);
+	if (initBlockSize < 1024)
+		initBlockSize = 1024;
+	maxBlockSize = MAXALIGN(maxBlockSize);
+	if (maxBlockSize < initBlockSize)
+		maxBlockSize = initBlockSize;
+	Assert(AllocHugeSizeIsValid(maxBlockSize)); /* must be safe to double */
+	set->initBlockSize = initBlockSize;
+	set->maxBlockSize = maxBlockSize;
+	set->nextBlockSize = initBlockSize;
+	set->allocChunkLimit = (maxBlockSize - BUMP_BLOCKHDRSZ) / BUMP_CHUNK_FRACTION;
+
+	/*
+	 * Grab always-allocated space, if requested
+	 */
+	if (minContextSize > BUMP_BLOCKHDRSZ + BUMP_CHUNKHDRSZ)
+	{
+		Size		blksize = MAXALIGN(minContextSize);
+		BumpBlock	block;
+
+		block = (BumpBlock) malloc(blksize);
+		if (block == NULL)
+		{
+			MemoryContextStats(TopMemoryContext);
+			ereport(ERROR,
+					(errcode(ERRCODE_OUT_OF_MEMORY),
+					 errmsg("out of memory"),
+					 errdetail("Failed while creating memory context \"%s\".",
+							   name)));
+		}
+		block->freeptr = ((char *) block) + BUMP_BLOCKHDRSZ;
+		block->endptr = ((char *) block) + blksize;
+		block->next = NULL;
+		set->blocks = block;
+		/* Mark block as not to be released at reset time */
+		set->keeper = block;
+		set->header.mem_allocated += blksize;
+
+		/* Mark unallocated space NOACCESS; leave the block header alone. */
+		VALGRIND_MAKE_MEM_NOACCESS(block->freeptr,
+								   blksize - BUMP_BLOCKHDRSZ);
+	}
+
+	return (MemoryContext) set;
+}
+
+/*
+ * BumpContextCreateFixed
+ *		Create a new Bump context in the given area of memory.
+ *
+ * area: MAXALIGN'd start of the area
+ * size: size of the area
+ * name: name of context (for debugging --- string will be copied)
+ *
+ * The context node and its only block are laid out in the area, so that
+ * the data allocated in the context stays valid in every process that has
+ * the area mapped at the same address.  The context has no parent, and it
+ * cannot be deleted, since there is nothing to free; the creator owns the
+ * area.  BumpContextFreeze tells how much of the area was used.
+ */
+MemoryContext
+BumpContextCreateFixed(void *area, Size size, const char *name)
+{
+	Bump		set = (Bump) area;
+	Size		nodesize = MAXALIGN(sizeof(BumpContext) + strlen(name) + 1);
+	BumpBlock	block;
+
+	Assert(area == (void *) MAXALIGN(area));
+
+	if (size < nodesize + BUMP_BLOCKHDRSZ)
+		ereport(ERROR,
+				(errcode(ERRCODE_OUT_OF_MEMORY),
+				 errmsg("out of memory"),
+				 errdetail("Failed while creating memory context \"%s\".",
+						   name)));
+
+	/* Do by hand what MemoryContextCreate does for ordinary contexts */
+	MemSet(set, 0, sizeof(BumpContext));
+	set->header.type = T_BumpContext;
+	set->header.methods = &BumpMethods;
+	set->header.isReset = true;
+	set->header.name = ((char *) set) + sizeof(BumpContext);
+	strcpy(set->header.name, name);
+	set->header.mem_allocated = size;
+
+	VALGRIND_CREATE_MEMPOOL(set, 0, false);
+
+	/* The rest of the area is the block, which we also keep over resets */
+	block = (BumpBlock) (((char *) area) + nodesize);
+	block->freeptr = ((char *) block) + BUMP_BLOCKHDRSZ;
+	block->endptr = ((char *) area) + size;
+	block->next = NULL;
+	set->blocks = block;
+	set->keeper = block;
+	set->fixed = true;
+
+	/* There are no dedicated blocks for large chunks */
+	set->allocChunkLimit = MaxAllocHugeSize;
+
+	VALGRIND_MAKE_MEM_NOACCESS(block->freeptr,
+							   block->endptr - block->freeptr);
+
+	return (MemoryContext) set;
+}
+
+/*
+ * BumpContextFreeze
+ *		Disallow any further allocation in a fixed Bump context, and return
+ *		the number of bytes at the start of its area that are in use.
+ */
+Size
+BumpContextFreeze(MemoryContext context)
+{
+	Bump		set = (Bump) context;
+
+	Assert(IsA(context, BumpContext));
+	Assert(set->fixed);
+
+	set->blocks->endptr = set->blocks->freeptr;
+
+	return set->blocks->freeptr - ((char *) set);
+}
+
+/*
+ * BumpInit
+ *		Context-type-specific initialization routine.
+ */
+static void
+BumpInit(MemoryContext context)
+{
+	/*
+	 * Since MemoryContextCreate already zeroed the context node, we don't
+	 * have to do anything here: it's already OK.
+	 */
+}
+
+/*
+ * BumpReset
+ *		Frees all memory which is allocated in the given context.
+ *
+ * As in aset.c, we hang onto the keeper block, if any, since per-tuple
+ * contexts are reset very often after small allocations.
+ */
+static void
+BumpReset(MemoryContext context)
+{
+	Bump		set = (Bump) context;
+	BumpBlock	block;
+
+#ifdef MEMORY_CONTEXT_CHECKING
+	/* Check for corruption and leaks before freeing */
+	BumpCheck(context);
+#endif
+
+	block = set->blocks;
+
+	/* New blocks list is either empty or just the keeper block */
+	set->blocks = set->keeper;
+
+	while (block != NULL)
+	{
+		BumpBlock	next = block->next;
+
+		if (block == set->keeper)
+		{
+			/* Reset the block, but don't return it to malloc */
+			char	   *datastart = ((char *) block) + BUMP_BLOCKHDRSZ;
+
+#ifdef CLOBBER_FREED_MEMORY
+			wipe_mem(datastart, block->freeptr - datastart);
+#else
+			/* wipe_mem() would have done this */
+			VALGRIND_MAKE_MEM_NOACCESS(datastart, block->freeptr - datastart);
+#endif
+			block->freeptr = datastart;
+			block->next = NULL;
+		}
+		else
+		{
+			/* Normal case, release the block */
+			set->header.mem_allocated -= block->endptr - ((char *) block);
+#ifdef CLOBBER_FREED_MEMORY
+			wipe_mem(block, block->freeptr - ((char *) block));
+#endif
+			free(block);
+		}
+		block = next;
+	}
+
+	/* Reset block size allocation sequence, too */
+	set->nextBlockSize = set->initBlockSize;
+}
+
+/*
+ * BumpDelete
+ *		Frees all memory which is allocated in the given context, in
+ *		preparation for deletion of the context.  We don't have to touch
+ *		the context node itself, which mcxt.c releases.
+ */
+static void
+BumpDelete(MemoryContext context)
+{
+	Bump		set = (Bump) context;
+	BumpBlock	block = set->blocks;
+
+	if (set->fixed)
+		elog(ERROR, "cannot delete fixed memory context \"%s\"",
+			 set->header.name);
+
+#ifdef MEMORY_CONTEXT_CHECKING
+	/* Check for corruption and leaks before freeing */
+	BumpCheck(context);
+#endif
+
+	/* Make it look empty, just in case... */
+	set->blocks = NULL;
+	set->keeper = NULL;
+
+	while (block != NULL)
+	{
+		BumpBlock	next = block->next;
+
+#ifdef CLOBBER_FREED_MEMORY
+		wipe_mem(block, block->freeptr - ((char *) block));
+#endif
+		free(block);
+		block = next;
+	}
+	set->header.mem_allocated = 0;
+}
+
+/*
+ * BumpAlloc
+ *		Returns pointer to allocated memory of given size or NULL if
+ *		request could not be completed; memory is added to the context.
+ */
+static void *
+BumpAlloc(MemoryContext context, Size size)
+{
+	Bump		set = (Bump) context;
+	BumpBlock	block;
+	StandardChunkHeader *header;
+	Size		chunk_size = MAXALIGN(size);
+	Size		blksize;
+
+	/*
+	 * If requested size exceeds maximum for chunks, allocate an entire block
+	 * for this request.
+	 */
+	if (chunk_size > set->allocChunkLimit)
+	{
+		blksize = chunk_size + BUMP_BLOCKHDRSZ + BUMP_CHUNKHDRSZ;
+		block = (BumpBlock) malloc(blksize);
+		if (block == NULL)
+			return NULL;
+		set->header.mem_allocated += blksize;
+		block->freeptr = block->endptr = ((char *) block) + blksize;
+
+		/*
+		 * Stick the new block underneath the active allocation block, so that
+		 * we don't lose the use of the space remaining therein.
+		 */
+		if (set->blocks != NULL)
+		{
+			block->next = set->blocks->next;
+			set->blocks->next = block;
+		}
+		else
+		{
+			block->next = NULL;
+			set->blocks = block;
+		}
+
+		header = (StandardChunkHeader *) (((char *) block) + BUMP_BLOCKHDRSZ);
+	}
+	else
+	{
+		/*
+		 * If there is not enough room in the active allocation block, start
+		 * a new one, doubling the block size each time as aset.c does.  The
+		 * rest of the old block is lost until the next reset.
+		 */
+		block = set->blocks;
+		if (block == NULL ||
+			(Size) (block->endptr - block->freeptr) < chunk_size + BUMP_CHUNKHDRSZ)
+		{
+			Size		required_size = chunk_size + BUMP_BLOCKHDRSZ + BUMP_CHUNKHDRSZ;
+
+			/* A fixed context can't get any more space */
+			if (set->fixed)
+				return NULL;
+
+			blksize = set->nextBlockSize;
+			set->nextBlockSize <<= 1;
+			if (set->nextBlockSize > set->maxBlockSize)
+				set->nextBlockSize = set->maxBlockSize;
+
+			/* If initBlockSize is less than the request, double it as needed */
+			while (blksize < required_size)
+				blksize <<= 1;
+
+			block = (BumpBlock) malloc(blksize);
+			if (block == NULL)
+				return NULL;
+			set->header.mem_allocated += blksize;
+			block->freeptr = ((char *) block) + BUMP_BLOCKHDRSZ;
+			block->endptr = ((char *) block) + blksize;
+
+			/* Mark unallocated space NOACCESS. */
+			VALGRIND_MAKE_MEM_NOACCESS(block->freeptr,
+									   blksize - BUMP_BLOCKHDRSZ);
+
+			/*
+			 * If this is the first block of the context, make it the
+			 * "keeper" block, as aset.c does.
+			 */
+			if (set->keeper == NULL && blksize == set->initBlockSize)
+				set->keeper = block;
+
+			block->next = set->blocks;
+			set->blocks = block;
+		}
+
+		header = (StandardChunkHeader *) block->freeptr;
+		VALGRIND_MAKE_MEM_UNDEFINED(header, BUMP_CHUNKHDRSZ + chunk_size);
+		block->freeptr += BUMP_CHUNKHDRSZ + chunk_size;
+		Assert(block->freeptr <= block->endptr);
+	}
+
+	header->context = context;
+	header->size = chunk_size;
+#ifdef MEMORY_CONTEXT_CHECKING
+	header->requested_size = size;
+	/* set mark to catch clobber of "unused" space */
+	if (size < chunk_size)
+		set_sentinel(BumpHeaderGetPointer(header), size);
+#endif
+#ifdef RANDOMIZE_ALLOCATED_MEMORY
+	/* fill the allocated space with junk */
+	randomize_mem((char *) BumpHeaderGetPointer(header), size);
+#endif
+
+	return BumpHeaderGetPointer(header);
+}
+
+/*
+ * BumpFree
+ *		Frees allocated memory, as far as a bump context can.
+ *
+ * Dedicated blocks go back to malloc(), and the most recently allocated
+ * chunk of the active block is given back to it.  All other chunks stay
+ * where they are until the context is reset.
+ */
+static void
+BumpFree(MemoryContext context, void *pointer)
+{
+	Bump		set = (Bump) context;
+	StandardChunkHeader *header = BumpPointerGetHeader(pointer);
+
+#ifdef MEMORY_CONTEXT_CHECKING
+	/* Test for someone scribbling on unused space in chunk */
+	if (header->requested_size < header->size)
+		if (!sentinel_ok(pointer, header->requested_size))
+			elog(WARNING, "detected write past chunk end in %s %p",
+				 set->header.name, pointer);
+#endif
+
+	if (header->size > set->allocChunkLimit)
+	{
+		/*
+		 * Big chunks are certain to have been allocated as single-chunk
+		 * blocks.  Find the containing block and return it to malloc().
+		 */
+		BumpBlock	block = set->blocks;
+		BumpBlock	prevblock = NULL;
+
+		while (block != NULL)
+		{
+			if ((char *) header == ((char *) block) + BUMP_BLOCKHDRSZ)
+				break;
+			prevblock = block;
+			block = block->next;
+		}
+		if (block == NULL)
+			elog(ERROR, "could not find block containing chunk %p", pointer);
+
+		/* OK, remove block from the list and free it */
+		if (prevblock == NULL)
+			set->blocks = block->next;
+		else
+			prevblock->next = block->next;
+		set->header.mem_allocated -= block->endptr - ((char *) block);
+#ifdef CLOBBER_FREED_MEMORY
+		wipe_mem(block, block->freeptr - ((char *) block));
+#endif
+		free(block);
+		return;
+	}
+
+#ifdef MEMORY_CONTEXT_CHECKING
+	/* Reset requested_size to 0 in chunks that are freed */
+	header->requested_size = 0;
+#endif
+#ifdef CLOBBER_FREED_MEMORY
+	wipe_mem(pointer, header->size);
+#endif
+
+	/* If it's the last chunk of the active block, we can reuse its space */
+	if (set->blocks != NULL &&
+		(char *) pointer + header->size == set->blocks->freeptr)
+	{
+		set->blocks->freeptr = (char *) header;
+		VALGRIND_MAKE_MEM_NOACCESS(header, BUMP_CHUNKHDRSZ);
+	}
+}
+
+/*
+ * BumpRealloc
+ *		Returns new pointer to allocated memory of given size or NULL if
+ *		request could not be completed; this memory is added to the context.
+ *		Memory associated with given pointer is copied into the new memory,
+ *		and the old memory is freed.
+ *
+ * The chunk is resized in place if it fits already, or if it's the last
+ * chunk of the active block and the block has room to spare.
+ */
+static void *
+BumpRealloc(MemoryContext context, void *pointer, Size size)
+{
+	Bump		set = (Bump) context;
+	StandardChunkHeader *header = BumpPointerGetHeader(pointer);
+	Size		oldsize = header->size;
+	void	   *newPointer;
+
+#ifdef MEMORY_CONTEXT_CHECKING
+	/* Test for someone scribbling on unused space in chunk */
+	if (header->requested_size < oldsize)
+		if (!sentinel_ok(pointer, header->requested_size))
+			elog(WARNING, "detected write past chunk end in %s %p",
+				 set->header.name, pointer);
+#endif
+
+	/*
+	 * Grow the last chunk of the active block in place if possible.  This
+	 * makes a StringInfo being built up in a bump context cheap.
+	 */
+	if (oldsize < size && oldsize <= set->allocChunkLimit &&
+		MAXALIGN(size) <= set->allocChunkLimit &&
+		set->blocks != NULL &&
+		(char *) pointer + oldsize == set->blocks->freeptr &&
+		(Size) (set->blocks->endptr - (char *) pointer) >= MAXALIGN(size))
+	{
+		set->blocks->freeptr = (char *) pointer + MAXALIGN(size);
+		VALGRIND_MAKE_MEM_UNDEFINED((char *) pointer + oldsize,
+									MAXALIGN(size) - oldsize);
+		header->size = oldsize = MAXALIGN(size);
+	}
+
+	/*
+	 * Maybe the allocated area already is >= the new size.  (In particular,
+	 * we always fall out here if the requested size is a decrease.)
+	 */
+	if (oldsize >= size)
+	{
+#ifdef MEMORY_CONTEXT_CHECKING
+		Size		oldrequest = header->requested_size;
+
+#ifdef RANDOMIZE_ALLOCATED_MEMORY
+		/* We can only fill the extra space if we know the prior request */
+		if (size > oldrequest)
+			randomize_mem((char *) pointer + oldrequest,
+						  size - oldrequest);
+#endif
+
+		header->requested_size = size;
+
+		/*
+		 * If this is an increase, mark any newly-available part UNDEFINED.
+		 * Otherwise, mark the obsolete part NOACCESS.
+		 */
+		if (size > oldrequest)
+			VALGRIND_MAKE_MEM_UNDEFINED((char *) pointer + oldrequest,
+										size - oldrequest);
+		else
+			VALGRIND_MAKE_MEM_NOACCESS((char *) pointer + size,
+									   oldsize - size);
+
+		/* set mark to catch clobber of "unused" space */
+		if (size < oldsize)
+			set_sentinel(pointer, size);
+#else							/* !MEMORY_CONTEXT_CHECKING */
+
+		/*
+		 * We don't have the information to determine whether we're growing
+		 * the old request or shrinking it, so we conservatively mark the
+		 * entire new allocation DEFINED.
+		 */
+		VALGRIND_MAKE_MEM_NOACCESS(pointer, oldsize);
+		VALGRIND_MAKE_MEM_DEFINED(pointer, size);
+#endif
+
+		return pointer;
+	}
+
+	/* allocate new chunk */
+	newPointer = BumpAlloc(context, size);
+
+	/* leave immediately if request was not completed */
+	if (newPointer == NULL)
+		return NULL;
+
+	/* transfer existing data (certain to fit) */
+#ifdef MEMORY_CONTEXT_CHECKING
+	memcpy(newPointer, pointer, header->requested_size);
+#else
+	memcpy(newPointer, pointer, oldsize);
+#endif
+
+	/* free old chunk */
+	BumpFree(context, pointer);
+
+	return newPointer;
+}
+
+/*
+ * BumpGetChunkSpace
+ *		Given a currently-allocated chunk, determine the total space
+ *		it occupies (including all memory-allocation overhead).
+ */
+static Size
+BumpGetChunkSpace(MemoryContext context, void *pointer)
+{
+	StandardChunkHeader *header = BumpPointerGetHeader(pointer);
+
+	return header->size + BUMP_CHUNKHDRSZ;
+}
+
+/*
+ * BumpIsEmpty
+ *		Is a bump context empty of any allocated space?
+ *
+ * As for AllocSet, we say "empty" only if the context is new or just reset.
+ */
+static bool
+BumpIsEmpty(MemoryContext context)
+{
+	if (context->isReset)
+		return true;
+	return false;
+}
+
+/*
+ * BumpStats
+ *		Displays stats about memory consumption of a bump context.
+ *
+ * There are no free chunks to report, only the unused tails of the blocks.
+ */
+static void
+BumpStats(MemoryContext context, int level)
+{
+	Bump		set = (Bump) context;
+	Size		nblocks = 0;
+	Size		totalspace = 0;
+	Size		freespace = 0;
+	BumpBlock	block;
+	int			i;
+
+	for (block = set->blocks; block != NULL; block = block->next)
+	{
+		nblocks++;
+		totalspace += block->endptr - ((char *) block);
+		freespace += block->endptr - block->freeptr;
+	}
+
+	for (i = 0; i < level; i++)
+		fprintf(stderr, "  ");
+
+	fprintf(stderr,
+			"%s: %zu total in %zd blocks; %zu free (%zd chunks); %zu used\n",
+			set->header.name, totalspace, nblocks, freespace, (Size) 0,
+			totalspace - freespace);
+}
+
+
+#ifdef MEMORY_CONTEXT_CHECKING
+
+/*
+ * BumpCheck
+ *		Walk through chunks and check consistency of memory.
+ *
+ * NOTE: report errors as WARNING, *not* ERROR or FATAL.  Otherwise you'll
+ * find yourself in an infinite loop when trouble occurs, because this
+ * routine will be entered again when elog cleanup tries to release memory!
+ */
+static void
+BumpCheck(MemoryContext context)
+{
+	Bump		set = (Bump) context;
+	char	   *name = set->header.name;
+	BumpBlock	block;
+
+	for (block = set->blocks; block != NULL; block = block->next)
+	{
+		char	   *bpoz = ((char *) block) + BUMP_BLOCKHDRSZ;
+
+		/*
+		 * Chunk walker
+		 */
+		while (bpoz < block->freeptr)
+		{
+			StandardChunkHeader *header = (StandardChunkHeader *) bpoz;
+			char	   *pointer = BumpHeaderGetPointer(header);
+			Size		chsize,
+						dsize;
+
+			VALGRIND_MAKE_MEM_DEFINED(header, BUMP_CHUNKHDRSZ);
+			chsize = header->size;		/* aligned chunk size */
+			dsize = header->requested_size;		/* real data */
+
+			if (header->context != context)
+				elog(WARNING, "problem in bump context %s: bogus context link in block %p, chunk %p",
+					 name, block, pointer);
+			if (dsize > chsize)
+				elog(WARNING, "problem in bump context %s: req size > alloc size for chunk %p in block %p",
+					 name, pointer, block);
+			if (bpoz + BUMP_CHUNKHDRSZ + chsize > block->freeptr)
+			{
+				elog(WARNING, "problem in bump context %s: bad size %zu for chunk %p in block %p",
+					 name, chsize, pointer, block);
+				break;
+			}
+
+			/* single-chunk block? */
+			if (chsize > set->allocChunkLimit &&
+				bpoz + BUMP_CHUNKHDRSZ + chsize != block->endptr)
+				elog(WARNING, "problem in bump context %s: bad single-chunk %p in block %p",
+					 name, pointer, block);
+
+			/*
+			 * Check for overwrite of "unallocated" space in chunk
+			 */
+			if (dsize > 0 && dsize < chsize &&
+				!sentinel_ok(pointer, dsize))
+				elog(WARNING, "problem in bump context %s: detected write past chunk end in block %p, chunk %p",
+					 name, block, pointer);
+
+			bpoz = pointer + chsize;
+		}
+	}
+}
+
+#endif   /* MEMORY_CONTEXT_CHECKING */
@@ -0,0 +1,651 @@
+/*-------------------------------------------------------------------------
+ *
+ * generation.c
+ *	  Generational allocator definitions.
+ *
+ * A generation context is a MemoryContext implementation for objects that
+ * are freed in roughly the order they were allocated, i.e. whose lifetimes
+ * overlap only a little, like the tuples held by a logical decoding reorder
+ * buffer until their transaction is replayed.
+ *
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * IDENTIFICATION
+ *	  src/backend/utils/mmgr/generation.c
+ *
+ *
+ * NOTE:
+ *	Chunks are carved sequentially out of the current block, without any
+ *	rounding beyond MAXALIGN, and pfree() never reuses their space; it only
+ *	counts the chunk as freed in its block.  Once every chunk of a block has
+ *	been freed, the whole block goes back to malloc().  With the intended
+ *	allocation pattern that happens to the oldest blocks first, so memory is
+ *	released steadily as the workload progresses, instead of fragmenting as
+ *	it would in an AllocSet, whose freelists can only reuse chunks of the
+ *	same size class and never free a block short of a reset.
+ *
+ *	Requests larger than a fraction of the block size get a dedicated block,
+ *	as in aset.c, so that they don't leave much of a regular block unused.
+ *
+ *	About CLOBBER_FREED_MEMORY and MEMORY_CONTEXT_CHECKING: see aset.c.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "lib/ilist.h"
+#include "utils/memdebug.h"
+#include "utils/memutils.h"
+
+
+/* We allow chunks to be at most 1/8 of blockSize before going solo */
+#define GENERATION_CHUNK_FRACTION	8
+
+typedef struct GenerationBlockData *GenerationBlock;	/* forward reference */
+
+/*
+ * GenerationContext is a specialized implementation of MemoryContext.
+ */
+typedef struct GenerationContext
+{
+	MemoryContextData header;	/* Standard memory-context fields */
+	/* Allocation parameters for this context: */
+	Size		blockSize;		/* standard block size */
+	Size		allocChunkLimit;	/* effective chunk size limit */
+	/* Info about storage allocated in this context: */
+	GenerationBlock block;		/* current (most recently allocated) block */
+	dlist_head	blocks;			/* list of blocks */
+} GenerationContext;
+
+typedef GenerationContext *Generation;
+
+/*
+ * GenerationBlock
+ *		The unit of memory that is obtained by generation.c from malloc().
+ *		Chunks are allocated from freeptr onwards; nchunks counts the chunks
+ *		ever allocated in the block and nfree those freed again.
+ */
+typedef struct GenerationBlockData
+{
+	dlist_node	node;			/* doubly-linked list of blocks */
+	Size		blksize;		/* allocated size of this block */
+	int			nchunks;		/* number of chunks in the block */
+	int			nfree;			/* number of free chunks */
+	char	   *freeptr;		/* start of free space in this block */
+	char	   *endptr;			/* end of space in this block */
+} GenerationBlockData;
+
+/*
+ * As in slab.c, each chunk starts with a pointer to its block, followed by
+ * the standard chunk header ending exactly where the chunk's data begins.
+ */
+#define GENERATION_BLOCKHDRSZ	MAXALIGN(sizeof(GenerationBlockData))
+#define GENERATION_CHUNKHDRSZ \
+	(MAXALIGN(sizeof(GenerationBlock)) + STANDARDCHUNKHEADERSIZE)
+
+#define GenerationPointerGetHeader(ptr) \
+	((StandardChunkHeader *) (((char *) (ptr)) - STANDARDCHUNKHEADERSIZE))
+#define GenerationPointerGetBlock(ptr) \
+	(*(GenerationBlock *) (((char *) (ptr)) - GENERATION_CHUNKHDRSZ))
+
+/*
+ * These functions implement the MemoryContext API for Generation contexts.
+ */
+static void *GenerationAlloc(MemoryContext context, Size size);
+static void GenerationFree(MemoryContext context, void *pointer);
+static void *GenerationRealloc(MemoryContext context, void *pointer, Size size);
+static void GenerationInit(MemoryContext context);
+static void GenerationReset(MemoryContext context);
+static void GenerationDelete(MemoryContext context);
+static Size GenerationGetChunkSpace(MemoryContext context, void *pointer);
+static bool GenerationIsEmpty(MemoryContext context);
+static void GenerationStats(MemoryContext context, int level);
+
+#ifdef MEMORY_CONTEXT_CHECKING
+static void GenerationCheck(MemoryContext context);
+#endif
+
+/*
+ * This is the virtual function table for Generation contexts.
+ */
+static MemoryContextMethods GenerationMethods = {
+	GenerationAlloc,
+	GenerationFree,
+	GenerationRealloc,
+	GenerationInit,
+	GenerationReset,
+	GenerationDelete,
+	GenerationGetChunkSpace,
+	GenerationIsEmpty,
+	GenerationStats
+#ifdef MEMORY_CONTEXT_CHECKING
+	,GenerationCheck
+#endif
+};
+
+#ifdef CLOBBER_FREED_MEMORY
+
+/* Wipe freed memory for debugging purposes */
+static void
+wipe_mem(void *ptr, size_t size)
+{
+	VALGRIND_MAKE_MEM_UNDEFINED(ptr, size);
+	memset(ptr, 0x7F, size);
+	VALGRIND_MAKE_MEM_NOACCESS(ptr, size);
+}
+#endif
+
+#ifdef MEMORY_CONTEXT_CHECKING
+static void
+set_sentinel(void *base, Size offset)
+{
+	char	   *ptr = (char *) base + offset;
+
+	VALGRIND_MAKE_MEM_UNDEFINED(ptr, 1);
+	*ptr = 0x7E;
+	VALGRIND_MAKE_MEM_NOACCESS(ptr, 1);
+}
+
+static bool
+sentinel_ok(const void *base, Size offset)
+{
+	const char *ptr = (const char *) base + offset;
+	bool		ret;
+
+	VALGRIND_MAKE_MEM_DEFINED(ptr, 1);
+	ret = *ptr == 0x7E;
+	VALGRIND_MAKE_MEM_NOACCESS(ptr, 1);
+
+	return ret;
+}
+#endif
+
+#ifdef RANDOMIZE_ALLOCATED_MEMORY
+
+/*
+ * Fill a just-allocated piece of memory with "random" data, as in aset.c.
+ */
+static void
+randomize_mem(char *ptr, size_t size)
+{
+	static int	save_ctr = 1;
+	size_t		remaining = size;
+	int			ctr;
+
+	ctr = save_ctr;
+	VALGRIND_MAKE_MEM_UNDEFINED(ptr, size);
+	while (remaining-- > 0)
+	{
+		*ptr++ = ctr;
+		if (++ctr > 251)
+			ctr = 1;
+	}
+	VALGRIND_MAKE_MEM_UNDEFINED(ptr - size, size);
+	save_ctr = ctr;
+}
+#endif   /* RANDOMIZE_ALLOCATED_MEMORY */
+
+
+/*
+ * Public routines
+ */
+
+
+/*
+ * GenerationContextCreate
+ *		Create a new Generation context.
+ *
+ * parent: parent context, or NULL if top-level context
+ * name: name of context (for debugging --- string will be copied)
+ * blockSize: allocation block size
+ */
+MemoryContext
+GenerationContextCreate(MemoryContext parent,
+						const char *name,
+						Size blockSize)
+{
+	Generation	set;
+
+	/* a block must at least be able to hold one chunk up to the limit */
+	blockSize = MAXALIGN(blockSize);
+	if (blockSize < 1024)
+		blockSize = 1024;
+
+	/* Do the type-independent part of context creation */
+	set = (Generation) MemoryContextCreate(T_GenerationContext,
+										   sizeof(GenerationContext),
+										   &GenerationMethods,
+										   parent,
+										   name);
+
+	set->blockSize = blockSize;
+	set->allocChunkLimit = blockSize / GENERATION_CHUNK_FRACTION;
+	set->block = NULL;
+
+	return (MemoryContext) set;
+}
+
+/*
+ * GenerationInit
+ *		Context-type-specific initialization routine.
+ */
+static void
+GenerationInit(MemoryContext context)
+{
+	Generation	set = (Generation) context;
+
+	set->block = NULL;
+	dlist_init(&set->blocks);
+}
+
+/*
+ * GenerationReset
+ *		Frees all memory which is allocated in the given set.
+ */
+static void
+GenerationReset(MemoryContext context)
+{
+	Generation	set = (Generation) context;
+	dlist_mutable_iter miter;
+
+#ifdef MEMORY_CONTEXT_CHECKING
+	/* Check for corruption and leaks before freeing */
+	GenerationCheck(context);
+#endif
+
+	dlist_foreach_modify(miter, &set->blocks)
+	{
+		GenerationBlock block = dlist_container(GenerationBlockData, node, miter.cur);
+
+		dlist_delete(miter.cur);
+#ifdef CLOBBER_FREED_MEMORY
+		wipe_mem(block, block->blksize);
+#endif
+		free(block);
+	}
+
+	set->block = NULL;
+	set->header.mem_allocated = 0;
+}
+
+/*
+ * GenerationDelete
+ *		Frees all memory which is allocated in the given set, in
+ *		preparation for deletion of the set.  We don't have to touch the
+ *		context node itself, which mcxt.c releases.
+ */
+static void
+GenerationDelete(MemoryContext context)
+{
+	GenerationReset(context);
+}
+
+/*
+ * GenerationAlloc
+ *		Returns pointer to allocated memory of given size or NULL if
+ *		request could not be completed; memory is added to the set.
+ */
+static void *
+GenerationAlloc(MemoryContext context, Size size)
+{
+	Generation	set = (Generation) context;
+	GenerationBlock block;
+	StandardChunkHeader *header;
+	char	   *pointer;
+	Size		chunk_size = MAXALIGN(size);
+	Size		required_size = chunk_size + GENERATION_CHUNKHDRSZ;
+
+	/*
+	 * If requested size exceeds maximum for chunks, allocate an entire block
+	 * for this request.  Otherwise use the current block if it has enough
+	 * room, or start a new one.
+	 */
+	if (chunk_size > set->allocChunkLimit)
+	{
+		Size		blksize = GENERATION_BLOCKHDRSZ + required_size;
+
+		block = (GenerationBlock) malloc(blksize);
+		if (block == NULL)
+			return NULL;
+		block->blksize = blksize;
+		block->endptr = ((char *) block) + blksize;
+
+		/*
+		 * Keep the current block as it is; the dedicated block goes onto the
+		 * list behind it, never to receive another chunk.
+		 */
+		dlist_push_head(&set->blocks, &block->node);
+	}
+	else
+	{
+		block = set->block;
+		if (block == NULL ||
+			(Size) (block->endptr - block->freeptr) < required_size)
+		{
+			Size		blksize = set->blockSize;
+
+			block = (GenerationBlock) malloc(blksize);
+			if (block == NULL)
+				return NULL;
+			block->blksize = blksize;
+			block->endptr = ((char *) block) + blksize;
+			dlist_push_head(&set->blocks, &block->node);
+			set->block = block;
+		}
+		else
+			required_size = 0;	/* block is already set up */
+	}
+
+	if (required_size != 0)
+	{
+		/* freshly malloc'd block */
+		set->header.mem_allocated += block->blksize;
+		block->nchunks = 0;
+		block->nfree = 0;
+		block->freeptr = ((char *) block) + GENERATION_BLOCKHDRSZ;
+	}
+
+	pointer = block->freeptr + GENERATION_CHUNKHDRSZ;
+	block->freeptr = pointer + chunk_size;
+	block->nchunks++;
+	Assert(block->freeptr <= block->endptr);
+
+	GenerationPointerGetBlock(pointer) = block;
+	header = GenerationPointerGetHeader(pointer);
+	header->context = context;
+	header->size = chunk_size;
+#ifdef MEMORY_CONTEXT_CHECKING
+	header->requested_size = size;
+	/* set mark to catch clobber of "unused" space */
+	if (size < chunk_size)
+		set_sentinel(pointer, size);
+#endif
+#ifdef RANDOMIZE_ALLOCATED_MEMORY
+	/* fill the allocated space with junk */
+	randomize_mem(pointer, size);
+#endif
+
+	return (void *) pointer;
+}
+
+/*
+ * GenerationFree
+ *		Update number of chunks freed in the block, and return the block to
+ *		malloc() once all of its chunks are free.
+ */
+static void
+GenerationFree(MemoryContext context, void *pointer)
+{
+	Generation	set = (Generation) context;
+	GenerationBlock block = GenerationPointerGetBlock(pointer);
+#if defined(MEMORY_CONTEXT_CHECKING) || defined(CLOBBER_FREED_MEMORY)
+	StandardChunkHeader *header = GenerationPointerGetHeader(pointer);
+#endif
+
+#ifdef MEMORY_CONTEXT_CHECKING
+	/* Test for someone scribbling on unused space in chunk */
+	if (header->requested_size < header->size)
+		if (!sentinel_ok(pointer, header->requested_size))
+			elog(WARNING, "detected write past chunk end in %s %p",
+				 set->header.name, pointer);
+	/* Reset requested_size to 0 in chunks that are free */
+	header->requested_size = 0;
+#endif
+
+#ifdef CLOBBER_FREED_MEMORY
+	wipe_mem(pointer, header->size);
+#endif
+
+	block->nfree++;
+	Assert(block->nfree <= block->nchunks);
+
+	/* if there's still an allocated chunk in the block, we're done */
+	if (block->nfree < block->nchunks)
+		return;
+
+	/*
+	 * The block is entirely free.  Give it back, except for the current block
+	 * which we may as well keep on filling: just rewind it.
+	 */
+	if (block == set->block)
+	{
+		block->nchunks = 0;
+		block->nfree = 0;
+		block->freeptr = ((char *) block) + GENERATION_BLOCKHDRSZ;
+		return;
+	}
+
+	dlist_delete(&block->node);
+	set->header.mem_allocated -= block->blksize;
+#ifdef CLOBBER_FREED_MEMORY
+	wipe_mem(block, block->blksize);
+#endif
+	free(block);
+}
+
+/*
+ * GenerationRealloc
+ *		When handling repalloc, we simply allocate a new chunk, copy the data
+ *		and discard the old one.  The only exception is when the new size
+ *		fits into the old chunk, in which case we just return the old chunk.
+ */
+static void *
+GenerationRealloc(MemoryContext context, void *pointer, Size size)
+{
+	StandardChunkHeader *header = GenerationPointerGetHeader(pointer);
+	Size		oldsize = header->size;
+	void	   *newPointer;
+
+#ifdef MEMORY_CONTEXT_CHECKING
+	/* Test for someone scribbling on unused space in chunk */
+	if (header->requested_size < oldsize)
+		if (!sentinel_ok(pointer, header->requested_size))
+			elog(WARNING, "detected write past chunk end in %s %p",
+				 context->name, pointer);
+#endif
+
+	/*
+	 * Maybe the allocated area already is >= the new size.  (In particular,
+	 * we always fall out here if the requested size is a decrease.)
+	 */
+	if (oldsize >= size)
+	{
+#ifdef MEMORY_CONTEXT_CHECKING
+		Size		oldrequest = header->requested_size;
+
+#ifdef RANDOMIZE_ALLOCATED_MEMORY
+		/* We can only fill the extra space if we know the prior request */
+		if (size > oldrequest)
+			randomize_mem((char *) pointer + oldrequest,
+						  size - oldrequest);
+#endif
+
+		header->requested_size = size;
+
+		/*
+		 * If this is an increase, mark any newly-available part UNDEFINED.
+		 * Otherwise, mark the obsolete part NOACCESS.
+		 */
+		if (size > oldrequest)
+			VALGRIND_MAKE_MEM_UNDEFINED((char *) pointer + oldrequest,
+										size - oldrequest);
+		else
+			VALGRIND_MAKE_MEM_NOACCESS((char *) pointer + size,
+									   oldsize - size);
+
+		/* set mark to catch clobber of "unused" space */
+		if (size < oldsize)
+			set_sentinel(pointer, size);
+#else							/* !MEMORY_CONTEXT_CHECKING */
+
+		/*
+		 * We don't have the information to determine whether we're growing
+		 * the old request or shrinking it, so we conservatively mark the
+		 * entire new allocation DEFINED.
+		 */
+		VALGRIND_MAKE_MEM_NOACCESS(pointer, oldsize);
+		VALGRIND_MAKE_MEM_DEFINED(pointer, size);
+#endif
+
+		return pointer;
+	}
+
+	/* allocate new chunk */
+	newPointer = GenerationAlloc(context, size);
+
+	/* leave immediately if request was not completed */
+	if (newPointer == NULL)
+		return NULL;
+
+	/* transfer existing data (certain to fit) */
+#ifdef MEMORY_CONTEXT_CHECKING
+	memcpy(newPointer, pointer, header->requested_size);
+#else
+	memcpy(newPointer, pointer, oldsize);
+#endif
+
+	/* free old chunk */
+	GenerationFree(context, pointer);
+
+	return newPointer;
+}
+
+/*
+ * GenerationGetChunkSpace
+ *		Given a currently-allocated chunk, determine the total space
+ *		it occupies (including all memory-allocation overhead).
+ */
+static Size
+GenerationGetChunkSpace(MemoryContext context, void *pointer)
+{
+	StandardChunkHeader *header = GenerationPointerGetHeader(pointer);
+
+	return header->size + GENERATION_CHUNKHDRSZ;
+}
+
+/*
+ * GenerationIsEmpty
+ *		Is a Generation context empty of any allocated space?
+ */
+static bool
+GenerationIsEmpty(MemoryContext context)
+{
+	Generation	set = (Generation) context;
+	dlist_iter	iter;
+
+	dlist_foreach(iter, &set->blocks)
+	{
+		GenerationBlock block = dlist_container(GenerationBlockData, node, iter.cur);
+
+		if (block->nchunks > block->nfree)
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * GenerationStats
+ *		Displays stats about memory consumption of a Generation context.
+ *
+ * Space taken by freed chunks is only reclaimed along with the whole block,
+ * so we report it as used, and count only the unallocated tail of the
+ * blocks as free; the number of chunks is that of the freed ones.
+ */
+static void
+GenerationStats(MemoryContext context, int level)
+{
+	Generation	set = (Generation) context;
+	Size		nblocks = 0;
+	Size		nchunks = 0;
+	Size		totalspace = 0;
+	Size		freespace = 0;
+	dlist_iter	iter;
+	int			i;
+
+	dlist_foreach(iter, &set->blocks)
+	{
+		GenerationBlock block = dlist_container(GenerationBlockData, node, iter.cur);
+
+		nblocks++;
+		nchunks += block->nfree;
+		totalspace += block->blksize;
+		freespace += block->endptr - block->freeptr;
+	}
+
+	for (i = 0; i < level; i++)
+		fprintf(stderr, "  ");
+
+	fprintf(stderr,
+			"%s: %zu total in %zd blocks; %zu free (%zd chunks); %zu used\n",
+			set->header.name, totalspace, nblocks, freespace, nchunks,
+			totalspace - freespace);
+}
+
+
+#ifdef MEMORY_CONTEXT_CHECKING
+
+/*
+ * GenerationCheck
+ *		Walk through chunks and check consistency of memory.
+ *
+ * NOTE: report errors as WARNING, *not* ERROR or FATAL.  Otherwise you'll
+ * find yourself in an infinite loop when trouble occurs, because this
+ * routine will be entered again when elog cleanup tries to release memory!
+ */
+static void
+GenerationCheck(MemoryContext context)
+{
+	Generation	set = (Generation) context;
+	char	   *name = set->header.name;
+	dlist_iter	iter;
+
+	dlist_foreach(iter, &set->blocks)
+	{
+		GenerationBlock block = dlist_container(GenerationBlockData, node, iter.cur);
+		int			nchunks = 0;
+		char	   *ptr = ((char *) block) + GENERATION_BLOCKHDRSZ;
+
+		/* empty blocks are freed right away, except the current block */
+		if (block->nchunks == 0 && block != set->block)
+			elog(WARNING, "problem in Generation %s: empty block %p",
+				 name, block);
+
+		/*
+		 * Chunk walker
+		 */
+		while (ptr < block->freeptr)
+		{
+			char	   *pointer = ptr + GENERATION_CHUNKHDRSZ;
+			StandardChunkHeader *header = GenerationPointerGetHeader(pointer);
+
+			nchunks++;
+
+			if (GenerationPointerGetBlock(pointer) != block ||
+				header->context != context)
+				elog(WARNING, "problem in Generation %s: bogus header in block %p, chunk %p",
+					 name, block, pointer);
+
+			/* requested_size is zero in freed chunks */
+			if (header->requested_size > header->size)
+				elog(WARNING, "problem in Generation %s: req size > alloc size for chunk %p in block %p",
+					 name, pointer, block);
+			else if (header->requested_size > 0 &&
+					 header->requested_size < header->size &&
+					 !sentinel_ok(pointer, header->requested_size))
+				elog(WARNING, "problem in Generation %s: detected write past chunk end in block %p, chunk %p",
+					 name, block, pointer);
+
+			ptr = pointer + header->size;
+		}
+
+		if (nchunks != block->nchunks)
+			elog(WARNING, "problem in Generation %s: number of chunks in block %p does not match header",
+				 name, block);
+	}
+}
+
+#endif   /* MEMORY_CONTEXT_CHECKING */
@@ -457,6 +457,35 @@ MemoryContextGetParent(MemoryContext context)
 	return context->parent;
 }
 
+/*
+ * MemoryContextMemAllocated
+ *		Return the amount of memory the context has obtained from malloc,
+ *		optionally including all its children.
+ *
+ * This counts whole blocks, including free space within them, so it is a
+ * measure of how much the context actually costs the process rather than of
+ * how much has been palloc'd from it.
+ */
+Size
+MemoryContextMemAllocated(MemoryContext context, bool recurse)
+{
+	Size		total = context->mem_allocated;
+
+	AssertArg(MemoryContextIsValid(context));
+
+	if (recurse)
+	{
+		MemoryContext child;
+
+		for (child = context->firstchild;
+			 child != NULL;
+			 child = child->nextchild)
+			total += MemoryContextMemAllocated(child, true);
+	}
+
+	return total;
+}
+
 /*
  * MemoryContextIsEmpty
  *		Is a memory context empty of any allocated space?
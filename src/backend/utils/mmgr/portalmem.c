@@ -1056,6 +1056,31 @@ pg_cursor(PG_FUNCTION_ARGS)
 	return (Datum) 0;
 }
 
+/*
+ * Are there any holdable cursors left over from earlier transactions?
+ */
+bool
+ThereAreHoldablePortals(void)
+{
+	HASH_SEQ_STATUS status;
+	PortalHashEnt *hentry;
+
+	hash_seq_init(&status, PortalHashTable);
+
+	while ((hentry = (PortalHashEnt *) hash_seq_search(&status)) != NULL)
+	{
+		Portal		portal = hentry->portal;
+
+		if (portal->visible && (portal->cursorOptions & CURSOR_OPT_HOLD))
+		{
+			hash_seq_term(&status);
+			return true;
+		}
+	}
+
+	return false;
+}
+
 bool
 ThereAreNoReadyPortals(void)
 {
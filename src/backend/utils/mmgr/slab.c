@@ -0,0 +1,688 @@
+/*-------------------------------------------------------------------------
+ *
+ * slab.c
+ *	  Slab allocator definitions.
+ *
+ * A slab context is a MemoryContext implementation for code that allocates
+ * and frees lots of objects of a single fixed size, such as the change and
+ * transaction structs of a logical decoding reorder buffer.
+ *
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * IDENTIFICATION
+ *	  src/backend/utils/mmgr/slab.c
+ *
+ *
+ * NOTE:
+ *	The constant allocation size allows significant simplification and
+ *	various optimizations over more general purpose allocators.  The blocks
+ *	are carved into chunks of exactly the right size (plus alignment), so
+ *	no memory is wasted on rounding requests up to a power of 2 as aset.c
+ *	does.
+ *
+ *	Each block keeps its own list of free chunks, and the context keeps the
+ *	blocks on lists indexed by their number of free chunks.  New chunks are
+ *	always taken from the fullest block that still has room, so that the
+ *	other blocks get a chance to become entirely free; a block is returned
+ *	to malloc() as soon as its last chunk is freed.  That way memory is
+ *	actually given back when the number of live objects shrinks, which an
+ *	AllocSet never does short of a reset.
+ *
+ *	The free chunks of a block are linked by their index within the block,
+ *	stored in the first bytes of the chunk's data area.  Finding a block's
+ *	freelist is therefore O(1) in both palloc and pfree, the only operation
+ *	that can be more expensive being the search for the next block to
+ *	allocate from once the current one fills up, which looks through at
+ *	most chunksPerBlock lists.
+ *
+ *	About CLOBBER_FREED_MEMORY and MEMORY_CONTEXT_CHECKING: see aset.c.
+ *	Freed chunks are wiped except for the bytes that hold the freelist
+ *	link, and a sentinel byte is kept after the requested size whenever
+ *	alignment leaves room for it.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "lib/ilist.h"
+#include "utils/memdebug.h"
+#include "utils/memutils.h"
+
+
+typedef struct SlabBlockData *SlabBlock;	/* forward reference */
+
+/*
+ * SlabContext is a specialized implementation of MemoryContext.
+ *
+ * freelist[i] holds the blocks having exactly i free chunks, for i from 0
+ * (full blocks) to chunksPerBlock - 1; entirely free blocks are released
+ * immediately and so never appear on any list.  minFreeChunks is the lowest
+ * nonzero i whose list is not empty, or 0 if no block has room.
+ */
+typedef struct SlabContext
+{
+	MemoryContextData header;	/* Standard memory-context fields */
+	/* Allocation parameters for this context: */
+	Size		chunkSize;		/* chunk size requested by the caller */
+	Size		fullChunkSize;	/* chunk size including header and alignment */
+	Size		blockSize;		/* block size */
+	int			chunksPerBlock; /* number of chunks per block */
+	int			minFreeChunks;	/* min number of free chunks in any block */
+	int			nblocks;		/* number of blocks allocated */
+	/* blocks with free space, grouped by number of free chunks: */
+	dlist_head	freelist[FLEXIBLE_ARRAY_MEMBER];
+} SlabContext;
+
+typedef SlabContext *Slab;
+
+/*
+ * SlabBlock
+ *		A SlabBlock is the unit of memory that is obtained by slab.c from
+ *		malloc().  It is cut into chunksPerBlock chunks of fullChunkSize
+ *		bytes each, starting at the next alignment boundary after the
+ *		header.
+ */
+typedef struct SlabBlockData
+{
+	dlist_node	node;			/* link in the context's freelist[nfree] */
+	int			nfree;			/* number of free chunks */
+	int			firstFreeChunk; /* index of the first free chunk */
+} SlabBlockData;
+
+/*
+ * Each chunk starts with a pointer to its block, followed by the standard
+ * chunk header, which must end exactly where the chunk's data begins so
+ * that mcxt.c finds it at the usual STANDARDCHUNKHEADERSIZE spacing.  We
+ * don't declare a struct for this since the standard header may carry
+ * trailing padding.
+ */
+#define SLAB_BLOCKHDRSZ		MAXALIGN(sizeof(SlabBlockData))
+#define SLAB_CHUNKHDRSZ		(MAXALIGN(sizeof(SlabBlock)) + STANDARDCHUNKHEADERSIZE)
+
+#define SlabPointerGetHeader(ptr) \
+	((StandardChunkHeader *) (((char *) (ptr)) - STANDARDCHUNKHEADERSIZE))
+#define SlabPointerGetBlock(ptr) \
+	(*(SlabBlock *) (((char *) (ptr)) - SLAB_CHUNKHDRSZ))
+#define SlabBlockGetPointer(slab, block, idx) \
+	((void *) (((char *) (block)) + SLAB_BLOCKHDRSZ + \
+			   (idx) * (slab)->fullChunkSize + SLAB_CHUNKHDRSZ))
+#define SlabPointerGetIndex(slab, block, ptr) \
+	((int) ((((char *) (ptr)) - SLAB_CHUNKHDRSZ - \
+			 (((char *) (block)) + SLAB_BLOCKHDRSZ)) / (slab)->fullChunkSize))
+
+/* The freelist link of a free chunk lives in its data area */
+#define SlabChunkNextFree(ptr)	(*(int32 *) (ptr))
+
+/*
+ * These functions implement the MemoryContext API for Slab contexts.
+ */
+static void *SlabAlloc(MemoryContext context, Size size);
+static void SlabFree(MemoryContext context, void *pointer);
+static void *SlabRealloc(MemoryContext context, void *pointer, Size size);
+static void SlabInit(MemoryContext context);
+static void SlabReset(MemoryContext context);
+static void SlabDelete(MemoryContext context);
+static Size SlabGetChunkSpace(MemoryContext context, void *pointer);
+static bool SlabIsEmpty(MemoryContext context);
+static void SlabStats(MemoryContext context, int level);
+
+#ifdef MEMORY_CONTEXT_CHECKING
+static void SlabCheck(MemoryContext context);
+#endif
+
+/*
+ * This is the virtual function table for Slab contexts.
+ */
+static MemoryContextMethods SlabMethods = {
+	SlabAlloc,
+	SlabFree,
+	SlabRealloc,
+	SlabInit,
+	SlabReset,
+	SlabDelete,
+	SlabGetChunkSpace,
+	SlabIsEmpty,
+	SlabStats
+#ifdef MEMORY_CONTEXT_CHECKING
+	,SlabCheck
+#endif
+};
+
+#ifdef CLOBBER_FREED_MEMORY
+
+/* Wipe freed memory for debugging purposes */
+static void
+wipe_mem(void *ptr, size_t size)
+{
+	VALGRIND_MAKE_MEM_UNDEFINED(ptr, size);
+	memset(ptr, 0x7F, size);
+	VALGRIND_MAKE_MEM_NOACCESS(ptr, size);
+}
+#endif
+
+#ifdef MEMORY_CONTEXT_CHECKING
+static void
+set_sentinel(void *base, Size offset)
+{
+	char	   *ptr = (char *) base + offset;
+
+	VALGRIND_MAKE_MEM_UNDEFINED(ptr, 1);
+	*ptr = 0x7E;
+	VALGRIND_MAKE_MEM_NOACCESS(ptr, 1);
+}
+
+static bool
+sentinel_ok(const void *base, Size offset)
+{
+	const char *ptr = (const char *) base + offset;
+	bool		ret;
+
+	VALGRIND_MAKE_MEM_DEFINED(ptr, 1);
+	ret = *ptr == 0x7E;
+	VALGRIND_MAKE_MEM_NOACCESS(ptr, 1);
+
+	return ret;
+}
+#endif
+
+#ifdef RANDOMIZE_ALLOCATED_MEMORY
+
+/*
+ * Fill a just-allocated piece of memory with "random" data, as in aset.c.
+ */
+static void
+randomize_mem(char *ptr, size_t size)
+{
+	static int	save_ctr = 1;
+	size_t		remaining = size;
+	int			ctr;
+
+	ctr = save_ctr;
+	VALGRIND_MAKE_MEM_UNDEFINED(ptr, size);
+	while (remaining-- > 0)
+	{
+		*ptr++ = ctr;
+		if (++ctr > 251)
+			ctr = 1;
+	}
+	VALGRIND_MAKE_MEM_UNDEFINED(ptr - size, size);
+	save_ctr = ctr;
+}
+#endif   /* RANDOMIZE_ALLOCATED_MEMORY */
+
+/*
+ * Recompute minFreeChunks after the list it pointed to became empty.
+ */
+static void
+SlabUpdateMinFreeChunks(Slab slab)
+{
+	int			i;
+
+	for (i = 1; i < slab->chunksPerBlock; i++)
+	{
+		if (!dlist_is_empty(&slab->freelist[i]))
+		{
+			slab->minFreeChunks = i;
+			return;
+		}
+	}
+	slab->minFreeChunks = 0;
+}
+
+
+/*
+ * Public routines
+ */
+
+
+/*
+ * SlabContextCreate
+ *		Create a new Slab context.
+ *
+ * parent: parent context, or NULL if top-level context
+ * name: name of context (for debugging --- string will be copied)
+ * blockSize: allocation block size
+ * chunkSize: allocation chunk size
+ *
+ * Every palloc() in the new context must ask for exactly chunkSize bytes.
+ */
+MemoryContext
+SlabContextCreate(MemoryContext parent,
+				  const char *name,
+				  Size blockSize,
+				  Size chunkSize)
+{
+	Slab		slab;
+	Size		fullChunkSize;
+	int			chunksPerBlock;
+	int			i;
+
+	/* the data area of a free chunk must be able to hold its freelist link */
+	fullChunkSize = SLAB_CHUNKHDRSZ + MAXALIGN(Max(chunkSize, sizeof(int32)));
+
+	if (blockSize < SLAB_BLOCKHDRSZ + fullChunkSize)
+		elog(ERROR, "block size %zu for slab is too small for %zu-byte chunks",
+			 blockSize, chunkSize);
+	chunksPerBlock = (blockSize - SLAB_BLOCKHDRSZ) / fullChunkSize;
+
+	/* Do the type-independent part of context creation */
+	slab = (Slab) MemoryContextCreate(T_SlabContext,
+									  offsetof(SlabContext, freelist) +
+									  chunksPerBlock * sizeof(dlist_head),
+									  &SlabMethods,
+									  parent,
+									  name);
+
+	slab->chunkSize = chunkSize;
+	slab->fullChunkSize = fullChunkSize;
+	slab->blockSize = blockSize;
+	slab->chunksPerBlock = chunksPerBlock;
+	slab->minFreeChunks = 0;
+	slab->nblocks = 0;
+	for (i = 0; i < chunksPerBlock; i++)
+		dlist_init(&slab->freelist[i]);
+
+	return (MemoryContext) slab;
+}
+
+/*
+ * SlabInit
+ *		Context-type-specific initialization routine.
+ *
+ * Everything we need is set up by SlabContextCreate, since the freelist
+ * array is sized by the chunk geometry computed there.
+ */
+static void
+SlabInit(MemoryContext context)
+{
+	/*
+	 * Since MemoryContextCreate already zeroed the context node, we don't
+	 * have to do anything here: the context is already marked as empty.
+	 */
+}
+
+/*
+ * SlabReset
+ *		Frees all memory which is allocated in the given slab.
+ */
+static void
+SlabReset(MemoryContext context)
+{
+	Slab		slab = (Slab) context;
+	int			i;
+
+#ifdef MEMORY_CONTEXT_CHECKING
+	/* Check for corruption and leaks before freeing */
+	SlabCheck(context);
+#endif
+
+	for (i = 0; i < slab->chunksPerBlock; i++)
+	{
+		dlist_mutable_iter miter;
+
+		dlist_foreach_modify(miter, &slab->freelist[i])
+		{
+			SlabBlock	block = dlist_container(SlabBlockData, node, miter.cur);
+
+			dlist_delete(miter.cur);
+#ifdef CLOBBER_FREED_MEMORY
+			wipe_mem(block, slab->blockSize);
+#endif
+			free(block);
+		}
+	}
+
+	slab->minFreeChunks = 0;
+	slab->nblocks = 0;
+	slab->header.mem_allocated = 0;
+}
+
+/*
+ * SlabDelete
+ *		Frees all memory which is allocated in the given slab, in
+ *		preparation for deletion of the slab.  We don't have to touch the
+ *		context node itself, which mcxt.c releases.
+ */
+static void
+SlabDelete(MemoryContext context)
+{
+	SlabReset(context);
+}
+
+/*
+ * SlabAlloc
+ *		Returns pointer to allocated memory of the context's chunk size,
+ *		or NULL if the request could not be completed.
+ */
+static void *
+SlabAlloc(MemoryContext context, Size size)
+{
+	Slab		slab = (Slab) context;
+	SlabBlock	block;
+	StandardChunkHeader *header;
+	void	   *pointer;
+	int			idx;
+
+	/* this should never be reached with any other size */
+	if (size != slab->chunkSize)
+		elog(ERROR, "unexpected alloc chunk size %zu (expected %zu)",
+			 size, slab->chunkSize);
+
+	/*
+	 * If no block has a free chunk, get a new one and thread all of its
+	 * chunks onto its freelist.
+	 */
+	if (slab->minFreeChunks == 0)
+	{
+		block = (SlabBlock) malloc(slab->blockSize);
+		if (block == NULL)
+			return NULL;
+		slab->header.mem_allocated += slab->blockSize;
+		slab->nblocks++;
+
+		block->nfree = slab->chunksPerBlock;
+		block->firstFreeChunk = 0;
+		for (idx = 0; idx < slab->chunksPerBlock; idx++)
+		{
+			pointer = SlabBlockGetPointer(slab, block, idx);
+			SlabPointerGetBlock(pointer) = block;
+			header = SlabPointerGetHeader(pointer);
+			header->context = context;
+			header->size = slab->fullChunkSize - SLAB_CHUNKHDRSZ;
+#ifdef MEMORY_CONTEXT_CHECKING
+			header->requested_size = 0;
+#endif
+			SlabChunkNextFree(pointer) = idx + 1;
+		}
+
+		/*
+		 * The block isn't linked into any list yet; it's the only one with
+		 * room, so it's where the allocation below takes place.
+		 */
+	}
+	else
+	{
+		block = dlist_head_element(SlabBlockData, node,
+								   &slab->freelist[slab->minFreeChunks]);
+		dlist_delete(&block->node);
+	}
+
+	/* take the first free chunk of the block */
+	Assert(block->nfree > 0);
+	idx = block->firstFreeChunk;
+	Assert(idx >= 0 && idx < slab->chunksPerBlock);
+	pointer = SlabBlockGetPointer(slab, block, idx);
+	VALGRIND_MAKE_MEM_DEFINED(pointer, sizeof(int32));
+	block->firstFreeChunk = SlabChunkNextFree(pointer);
+	block->nfree--;
+
+	/*
+	 * Move the block to the list for its new free count.  Every other block
+	 * with free chunks has at least as many as this one had, so this one
+	 * determines minFreeChunks unless it just became full.
+	 */
+	dlist_push_head(&slab->freelist[block->nfree], &block->node);
+	if (block->nfree > 0)
+		slab->minFreeChunks = block->nfree;
+	else
+		SlabUpdateMinFreeChunks(slab);
+
+	header = SlabPointerGetHeader(pointer);
+	Assert(header->context == context);
+#ifdef MEMORY_CONTEXT_CHECKING
+	header->requested_size = size;
+	/* set mark to catch clobber of "unused" space */
+	if (size < header->size)
+		set_sentinel(pointer, size);
+#endif
+#ifdef RANDOMIZE_ALLOCATED_MEMORY
+	/* fill the allocated space with junk */
+	randomize_mem((char *) pointer, size);
+#endif
+
+	return pointer;
+}
+
+/*
+ * SlabFree
+ *		Frees allocated memory; memory is removed from the slab.
+ */
+static void
+SlabFree(MemoryContext context, void *pointer)
+{
+	Slab		slab = (Slab) context;
+	SlabBlock	block = SlabPointerGetBlock(pointer);
+#if defined(MEMORY_CONTEXT_CHECKING) || defined(CLOBBER_FREED_MEMORY)
+	StandardChunkHeader *header = SlabPointerGetHeader(pointer);
+#endif
+	int			idx;
+
+#ifdef MEMORY_CONTEXT_CHECKING
+	/* Test for someone scribbling on unused space in chunk */
+	if (header->requested_size < header->size)
+		if (!sentinel_ok(pointer, header->requested_size))
+			elog(WARNING, "detected write past chunk end in %s %p",
+				 slab->header.name, pointer);
+	/* Reset requested_size to 0 in chunks that are free */
+	header->requested_size = 0;
+#endif
+
+#ifdef CLOBBER_FREED_MEMORY
+	wipe_mem(pointer, header->size);
+	VALGRIND_MAKE_MEM_UNDEFINED(pointer, sizeof(int32));
+#endif
+
+	/* put the chunk on the block's freelist */
+	idx = SlabPointerGetIndex(slab, block, pointer);
+	Assert(idx >= 0 && idx < slab->chunksPerBlock);
+	SlabChunkNextFree(pointer) = block->firstFreeChunk;
+	block->firstFreeChunk = idx;
+	block->nfree++;
+	Assert(block->nfree <= slab->chunksPerBlock);
+
+	dlist_delete(&block->node);
+
+	if (block->nfree < slab->chunksPerBlock)
+	{
+		dlist_push_head(&slab->freelist[block->nfree], &block->node);
+
+		/* the block may now be the one with the fewest free chunks */
+		if (slab->minFreeChunks == 0 || block->nfree < slab->minFreeChunks)
+		{
+			slab->minFreeChunks = block->nfree;
+			return;
+		}
+	}
+	else
+	{
+		/* the block is entirely free, so give it back */
+		slab->header.mem_allocated -= slab->blockSize;
+		slab->nblocks--;
+#ifdef CLOBBER_FREED_MEMORY
+		wipe_mem(block, slab->blockSize);
+#endif
+		free(block);
+	}
+
+	/* the block may have been the last one at minFreeChunks */
+	if (slab->minFreeChunks > 0 &&
+		dlist_is_empty(&slab->freelist[slab->minFreeChunks]))
+		SlabUpdateMinFreeChunks(slab);
+}
+
+/*
+ * SlabRealloc
+ *		Changes the size of allocated memory.
+ *
+ * Since all chunks of a slab have the same size, the only "reallocation" we
+ * can perform is a no-op one.  Anything else is a caller bug.
+ */
+static void *
+SlabRealloc(MemoryContext context, void *pointer, Size size)
+{
+	Slab		slab = (Slab) context;
+
+	if (size == slab->chunkSize)
+		return pointer;
+
+	elog(ERROR, "slab allocator does not support realloc()");
+	return NULL;				/* keep compiler quiet */
+}
+
+/*
+ * SlabGetChunkSpace
+ *		Given a currently-allocated chunk, determine the total space
+ *		it occupies (including all memory-allocation overhead).
+ */
+static Size
+SlabGetChunkSpace(MemoryContext context, void *pointer)
+{
+	Slab		slab = (Slab) context;
+
+	return slab->fullChunkSize;
+}
+
+/*
+ * SlabIsEmpty
+ *		Is the slab empty of any allocated space?
+ *
+ * Unlike an AllocSet, a slab knows exactly: it has no blocks left once the
+ * last chunk has been freed.
+ */
+static bool
+SlabIsEmpty(MemoryContext context)
+{
+	Slab		slab = (Slab) context;
+
+	return (slab->nblocks == 0);
+}
+
+/*
+ * SlabStats
+ *		Displays stats about memory consumption of a slab.
+ */
+static void
+SlabStats(MemoryContext context, int level)
+{
+	Slab		slab = (Slab) context;
+	Size		nblocks = 0;
+	Size		nchunks = 0;
+	Size		totalspace = 0;
+	Size		freespace = 0;
+	int			i;
+
+	for (i = 0; i < slab->chunksPerBlock; i++)
+	{
+		dlist_iter	iter;
+
+		dlist_foreach(iter, &slab->freelist[i])
+		{
+			SlabBlock	block = dlist_container(SlabBlockData, node, iter.cur);
+
+			nblocks++;
+			totalspace += slab->blockSize;
+			nchunks += block->nfree;
+			freespace += slab->fullChunkSize * block->nfree;
+		}
+	}
+
+	for (i = 0; i < level; i++)
+		fprintf(stderr, "  ");
+
+	fprintf(stderr,
+			"%s: %zu total in %zd blocks; %zu free (%zd chunks); %zu used\n",
+			slab->header.name, totalspace, nblocks, freespace, nchunks,
+			totalspace - freespace);
+}
+
+
+#ifdef MEMORY_CONTEXT_CHECKING
+
+/*
+ * SlabCheck
+ *		Walk through chunks and check consistency of memory.
+ *
+ * NOTE: report errors as WARNING, *not* ERROR or FATAL.  Otherwise you'll
+ * find yourself in an infinite loop when trouble occurs, because this
+ * routine will be entered again when elog cleanup tries to release memory!
+ */
+static void
+SlabCheck(MemoryContext context)
+{
+	Slab		slab = (Slab) context;
+	char	   *name = slab->header.name;
+	int			nblocks = 0;
+	int			i;
+
+	for (i = 0; i < slab->chunksPerBlock; i++)
+	{
+		dlist_iter	iter;
+
+		dlist_foreach(iter, &slab->freelist[i])
+		{
+			SlabBlock	block = dlist_container(SlabBlockData, node, iter.cur);
+			int			nfree = 0;
+			int			idx;
+
+			nblocks++;
+
+			if (block->nfree != i)
+				elog(WARNING, "problem in slab %s: block %p on freelist %d has %d free chunks",
+					 name, block, i, block->nfree);
+
+			/* walk the block's freelist */
+			for (idx = block->firstFreeChunk;
+				 idx < slab->chunksPerBlock && nfree <= block->nfree;
+				 nfree++)
+			{
+				void	   *pointer = SlabBlockGetPointer(slab, block, idx);
+
+				if (idx < 0)
+				{
+					elog(WARNING, "problem in slab %s: bogus freelist link in block %p",
+						 name, block);
+					break;
+				}
+				if (SlabPointerGetHeader(pointer)->requested_size != 0)
+					elog(WARNING, "problem in slab %s: allocated chunk %p on freelist of block %p",
+						 name, pointer, block);
+				VALGRIND_MAKE_MEM_DEFINED(pointer, sizeof(int32));
+				idx = SlabChunkNextFree(pointer);
+				VALGRIND_MAKE_MEM_NOACCESS(pointer, sizeof(int32));
+			}
+			if (nfree != block->nfree)
+				elog(WARNING, "problem in slab %s: found inconsistent freelist in block %p",
+					 name, block);
+
+			/* check the allocated chunks */
+			for (idx = 0; idx < slab->chunksPerBlock; idx++)
+			{
+				void	   *pointer = SlabBlockGetPointer(slab, block, idx);
+				StandardChunkHeader *header = SlabPointerGetHeader(pointer);
+
+				if (SlabPointerGetBlock(pointer) != block ||
+					header->context != context)
+					elog(WARNING, "problem in slab %s: bogus header in block %p, chunk %p",
+						 name, block, pointer);
+				if (header->requested_size == 0)
+					continue;
+				if (header->requested_size > header->size)
+					elog(WARNING, "problem in slab %s: req size > alloc size for chunk %p in block %p",
+						 name, pointer, block);
+				else if (header->requested_size < header->size &&
+						 !sentinel_ok(pointer, header->requested_size))
+					elog(WARNING, "problem in slab %s: detected write past chunk end in block %p, chunk %p",
+						 name, block, pointer);
+			}
+		}
+	}
+
+	if (nblocks != slab->nblocks)
+		elog(WARNING, "problem in slab %s: found %d blocks, expected %d",
+			 name, nblocks, slab->nblocks);
+}
+
+#endif   /* MEMORY_CONTEXT_CHECKING */
@@ -33,6 +33,42 @@ typedef struct
 } SortShimExtra;
 
 
+/*
+ * Comparators for keys that are stored directly in the Datum, as an int32,
+ * or (on 64-bit platforms) as an int64.  Opclasses with such keys should use
+ * these rather than comparators of their own, because tuplesort.c recognizes
+ * them and sorts with the comparison inlined.
+ */
+int
+ssup_datum_int32_cmp(Datum x, Datum y, SortSupport ssup)
+{
+	int32		a = DatumGetInt32(x);
+	int32		b = DatumGetInt32(y);
+
+	if (a < b)
+		return -1;
+	else if (a > b)
+		return 1;
+	else
+		return 0;
+}
+
+#if SIZEOF_DATUM >= 8
+int
+ssup_datum_signed_cmp(Datum x, Datum y, SortSupport ssup)
+{
+	int64		a = (int64) x;
+	int64		b = (int64) y;
+
+	if (a < b)
+		return -1;
+	else if (a > b)
+		return 1;
+	else
+		return 0;
+}
+#endif
+
 /*
  * Shim function for calling an old-style comparator
  *
@@ -794,7 +794,8 @@ tuplestore_puttuple_common(Tuplestorestate *state, void *tuple)
 			oldowner = CurrentResourceOwner;
 			CurrentResourceOwner = state->resowner;
 
-			state->myfile = BufFileCreateTemp(state->interXact);
+			state->myfile = BufFileCreateTempExtended(state->interXact,
+													  BUFFILE_WRITE_BEHIND);
 
 			CurrentResourceOwner = oldowner;
 
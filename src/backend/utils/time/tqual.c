@@ -1494,16 +1494,31 @@ XidInMVCCSnapshot(TransactionId xid, Snapshot snapshot)
 		}
 		else
 		{
-			/* overflowed, so convert xid to top-level */
-			xid = SubTransGetTopmostTransaction(xid);
+			TransactionId topxid;
 
 			/*
-			 * If xid was indeed a subxact, we might now have an xid < xmin,
-			 * so recheck to avoid an array scan.  No point in rechecking
-			 * xmax.
+			 * Overflowed.  Top-level XIDs are all in xip[], so check there
+			 * first: if xid is a running top-level transaction, we needn't
+			 * consult pg_subtrans at all.
 			 */
-			if (TransactionIdPrecedes(xid, snapshot->xmin))
+			for (i = 0; i < snapshot->xcnt; i++)
+			{
+				if (TransactionIdEquals(xid, snapshot->xip[i]))
+					return true;
+			}
+
+			/* Convert xid to top-level */
+			topxid = SubTransGetTopmostTransaction(xid);
+
+			/*
+			 * If xid was top-level after all, we've already searched for it.
+			 * If it was indeed a subxact, we might now have an xid < xmin, so
+			 * recheck to avoid an array scan.  No point in rechecking xmax.
+			 */
+			if (TransactionIdEquals(topxid, xid) ||
+				TransactionIdPrecedes(topxid, snapshot->xmin))
 				return false;
+			xid = topxid;
 		}
 
 		for (i = 0; i < snapshot->xcnt; i++)
@@ -15,6 +15,7 @@
 
 #include <unistd.h>
 #include <dirent.h>
+#include <arpa/inet.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -60,6 +61,9 @@ static char *label = "pg_basebackup base backup";
 static bool showprogress = false;
 static int	verbose = 0;
 static int	compresslevel = 0;
+static bool servercompress = false;
+static bool incremental = false;
+static char incremental_start[64];
 static bool includewal = false;
 static bool streamwal = false;
 static bool fastcheckpoint = false;
@@ -94,6 +98,27 @@ static volatile LONG has_xlogendptr = 0;
 /* Contents of recovery.conf to be generated */
 static PQExpBuffer recoveryconfcontents = NULL;
 
+/*
+ * In an incremental backup, the paths received for the current tablespace,
+ * so that the files left over from the previous backup can be removed.
+ */
+static char **received_paths = NULL;
+static int	nreceived_paths = 0;
+static int	maxreceived_paths = 0;
+
+/* State of the incremental file being received */
+typedef struct IncrementalFileState
+{
+	IncrementalFileHeader hdr;	/* in host byte order, once complete */
+	size_t		hdrlen;			/* bytes of the header received */
+	uint32	   *blocks;			/* numbers of the blocks sent */
+	size_t		blockslen;		/* bytes of block numbers received */
+	bool		checked;		/* block numbers checked, file resized? */
+	uint32		curblock;		/* index in blocks of the block receiving */
+	char		blockbuf[BLCKSZ];
+	size_t		blockbuflen;	/* bytes of the current block received */
+} IncrementalFileState;
+
 /* Function headers */
 static void usage(void);
 static void disconnect_and_exit(int code);
@@ -101,7 +126,15 @@ static void verify_dir_is_empty_or_create(char *dirname);
 static void progress_report(int tablespacenum, const char *filename, bool force);
 
 static void ReceiveTarFile(PGconn *conn, PGresult *res, int rownum);
+#ifdef HAVE_LIBZ
+static void ReceiveCompressedTarFile(PGconn *conn, PGresult *res, int rownum);
+#endif
 static void ReceiveAndUnpackTarFile(PGconn *conn, PGresult *res, int rownum);
+static void ReadPreviousBackupStart(void);
+static void RecordReceivedPath(const char *path);
+static void RemoveUnreceivedFiles(const char *path, bool skipxlog);
+static void ApplyIncrementalData(IncrementalFileState *state, FILE *file,
+					 const char *filename, char *data, int len);
 static void GenerateRecoveryConf(PGconn *conn);
 static void WriteRecoveryConf(void);
 static void BaseBackup(void);
@@ -247,6 +280,9 @@ usage(void)
 	printf(_("      --xlogdir=XLOGDIR  location for the transaction log directory\n"));
 	printf(_("  -z, --gzip             compress tar output\n"));
 	printf(_("  -Z, --compress=0-9     compress tar output with given compression level\n"));
+	printf(_("      --server-compress  compress tar output on the server\n"));
+	printf(_("      --incremental      update the plain format backup in DIRECTORY, receiving\n"
+			 "                         only the blocks changed since it was taken\n"));
 	printf(_("\nGeneral options:\n"));
 	printf(_("  -c, --checkpoint=fast|spread\n"
 			 "                         set fast or spread checkpointing\n"));
@@ -1105,6 +1141,150 @@ ReceiveTarFile(PGconn *conn, PGresult *res, int rownum)
 		PQfreemem(copybuf);
 }
 
+#ifdef HAVE_LIBZ
+/*
+ * Receive a tar file that the server has already compressed with gzip, and
+ * write it as it is, to base.tar.gz or <tablespaceoid>.tar.gz.
+ *
+ * The end-of-archive blocks, preceded by recovery.conf if requested, are
+ * then appended as a separate gzip member, which gzip and tar read as the
+ * continuation of the same stream.  If the server sent a recovery.conf of
+ * its own, ours comes later in the archive and overrides it on extraction.
+ */
+static void
+ReceiveCompressedTarFile(PGconn *conn, PGresult *res, int rownum)
+{
+	char		filename[MAXPGPATH];
+	char	   *copybuf = NULL;
+	FILE	   *tarfile;
+	gzFile		ztarfile;
+	char		zerobuf[1024];
+	bool		basetablespace = PQgetisnull(res, rownum, 0);
+
+	if (strcmp(basedir, "-") == 0)
+	{
+		tarfile = stdout;
+		strcpy(filename, "-");
+	}
+	else
+	{
+		if (basetablespace)
+			snprintf(filename, sizeof(filename), "%s/base.tar.gz", basedir);
+		else
+			snprintf(filename, sizeof(filename), "%s/%s.tar.gz", basedir,
+					 PQgetvalue(res, rownum, 0));
+		tarfile = fopen(filename, "wb");
+		if (!tarfile)
+		{
+			fprintf(stderr, _("%s: could not create file \"%s\": %s\n"),
+					progname, filename, strerror(errno));
+			disconnect_and_exit(1);
+		}
+	}
+
+	/*
+	 * Get the COPY data stream
+	 */
+	res = PQgetResult(conn);
+	if (PQresultStatus(res) != PGRES_COPY_OUT)
+	{
+		fprintf(stderr, _("%s: could not get COPY data stream: %s"),
+				progname, PQerrorMessage(conn));
+		disconnect_and_exit(1);
+	}
+
+	while (1)
+	{
+		int			r;
+
+		if (copybuf != NULL)
+		{
+			PQfreemem(copybuf);
+			copybuf = NULL;
+		}
+
+		r = PQgetCopyData(conn, &copybuf, 0);
+		if (r == -1)
+			break;				/* end of chunk */
+		else if (r == -2)
+		{
+			fprintf(stderr, _("%s: could not read COPY data: %s"),
+					progname, PQerrorMessage(conn));
+			disconnect_and_exit(1);
+		}
+
+		if (fwrite(copybuf, r, 1, tarfile) != 1)
+		{
+			fprintf(stderr, _("%s: could not write to file \"%s\": %s\n"),
+					progname, filename, strerror(errno));
+			disconnect_and_exit(1);
+		}
+		totaldone += r;
+		progress_report(rownum, filename, false);
+	}
+	progress_report(rownum, filename, true);
+
+	if (fflush(tarfile) != 0)
+	{
+		fprintf(stderr, _("%s: could not write to file \"%s\": %s\n"),
+				progname, filename, strerror(errno));
+		disconnect_and_exit(1);
+	}
+
+	/* Append the trailing gzip member */
+	ztarfile = gzdopen(dup(fileno(tarfile)), "wb");
+	if (ztarfile == NULL || gzsetparams(ztarfile, compresslevel,
+										Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		fprintf(stderr,
+				_("%s: could not create compressed file \"%s\": %s\n"),
+				progname, filename, get_gz_error(ztarfile));
+		disconnect_and_exit(1);
+	}
+
+	MemSet(zerobuf, 0, sizeof(zerobuf));
+	if (basetablespace && writerecoveryconf)
+	{
+		char		header[512];
+		int			padding;
+
+		tarCreateHeader(header, "recovery.conf", NULL,
+						recoveryconfcontents->len,
+						0600, 04000, 02000,
+						time(NULL));
+
+		padding = ((recoveryconfcontents->len + 511) & ~511) - recoveryconfcontents->len;
+
+		writeTarData(ztarfile, NULL, header, sizeof(header), filename);
+		writeTarData(ztarfile, NULL, recoveryconfcontents->data,
+					 recoveryconfcontents->len, filename);
+		if (padding)
+			writeTarData(ztarfile, NULL, zerobuf, padding, filename);
+	}
+
+	/* 2 * 512 bytes empty data at end of file */
+	writeTarData(ztarfile, NULL, zerobuf, sizeof(zerobuf), filename);
+
+	if (gzclose(ztarfile) != 0)
+	{
+		fprintf(stderr,
+				_("%s: could not close compressed file \"%s\": %s\n"),
+				progname, filename, get_gz_error(ztarfile));
+		disconnect_and_exit(1);
+	}
+
+	if (strcmp(basedir, "-") != 0 && fclose(tarfile) != 0)
+	{
+		fprintf(stderr, _("%s: could not close file \"%s\": %s\n"),
+				progname, filename, strerror(errno));
+		disconnect_and_exit(1);
+	}
+
+	if (copybuf != NULL)
+		PQfreemem(copybuf);
+}
+#endif   /* HAVE_LIBZ */
+
 
 /*
  * Retrieve tablespace path, either relocated or original depending on whether
@@ -1143,6 +1323,7 @@ ReceiveAndUnpackTarFile(PGconn *conn, PGresult *res, int rownum)
 	bool		basetablespace;
 	char	   *copybuf = NULL;
 	FILE	   *file = NULL;
+	IncrementalFileState *incrstate = NULL;
 
 	basetablespace = PQgetisnull(res, rownum, 0);
 	if (basetablespace)
@@ -1244,6 +1425,8 @@ ReceiveAndUnpackTarFile(PGconn *conn, PGresult *res, int rownum)
 					 * Directory
 					 */
 					filename[strlen(filename) - 1] = '\0';		/* Remove trailing slash */
+					if (incremental)
+						RecordReceivedPath(filename);
 					if (mkdir(filename, S_IRWXU) != 0)
 					{
 						/*
@@ -1252,9 +1435,11 @@ ReceiveAndUnpackTarFile(PGconn *conn, PGresult *res, int rownum)
 						 * log directory location was specified, pg_xlog has
 						 * already been created as a symbolic link before
 						 * starting the actual backup. So just ignore creation
-						 * failures on related directories.
+						 * failures on related directories.  In an incremental
+						 * backup, all directories can exist already.
 						 */
-						if (!((pg_str_endswith(filename, "/pg_xlog") ||
+						if (!((incremental ||
+							   pg_str_endswith(filename, "/pg_xlog") ||
 							 pg_str_endswith(filename, "/archive_status")) &&
 							  errno == EEXIST))
 						{
@@ -1287,6 +1472,18 @@ ReceiveAndUnpackTarFile(PGconn *conn, PGresult *res, int rownum)
 					 */
 					filename[strlen(filename) - 1] = '\0';		/* Remove trailing slash */
 
+					if (incremental)
+					{
+						RecordReceivedPath(filename);
+						if (unlink(filename) != 0 && errno != ENOENT)
+						{
+							fprintf(stderr,
+									_("%s: could not remove file \"%s\": %s\n"),
+									progname, filename, strerror(errno));
+							disconnect_and_exit(1);
+						}
+					}
+
 					mapped_tblspc_path = get_tablespace_mapping(&copybuf[157]);
 					if (symlink(mapped_tblspc_path, filename) != 0)
 					{
@@ -1309,8 +1506,24 @@ ReceiveAndUnpackTarFile(PGconn *conn, PGresult *res, int rownum)
 
 			/*
 			 * regular file
+			 *
+			 * In an incremental backup, a file sent incrementally updates the
+			 * file of the same name, without the suffix, which need not exist
+			 * if the relation is new.
 			 */
-			file = fopen(filename, "wb");
+			if (incremental &&
+				pg_str_endswith(filename, INCREMENTAL_FILE_SUFFIX))
+			{
+				filename[strlen(filename) - strlen(INCREMENTAL_FILE_SUFFIX)] = '\0';
+				file = fopen(filename, "r+b");
+				if (!file && errno == ENOENT)
+					file = fopen(filename, "w+b");
+				incrstate = pg_malloc0(sizeof(IncrementalFileState));
+			}
+			else
+				file = fopen(filename, "wb");
+			if (incremental)
+				RecordReceivedPath(filename);
 			if (!file)
 			{
 				fprintf(stderr, _("%s: could not create file \"%s\": %s\n"),
@@ -1347,11 +1560,20 @@ ReceiveAndUnpackTarFile(PGconn *conn, PGresult *res, int rownum)
 				 */
 				fclose(file);
 				file = NULL;
+				if (incrstate)
+				{
+					if (incrstate->blocks)
+						pg_free(incrstate->blocks);
+					pg_free(incrstate);
+					incrstate = NULL;
+				}
 				totaldone += r;
 				continue;
 			}
 
-			if (fwrite(copybuf, r, 1, file) != 1)
+			if (incrstate)
+				ApplyIncrementalData(incrstate, file, filename, copybuf, r);
+			else if (fwrite(copybuf, r, 1, file) != 1)
 			{
 				fprintf(stderr, _("%s: could not write to file \"%s\": %s\n"),
 						progname, filename, strerror(errno));
@@ -1370,6 +1592,13 @@ ReceiveAndUnpackTarFile(PGconn *conn, PGresult *res, int rownum)
 				 */
 				fclose(file);
 				file = NULL;
+				if (incrstate)
+				{
+					if (incrstate->blocks)
+						pg_free(incrstate->blocks);
+					pg_free(incrstate);
+					incrstate = NULL;
+				}
 				continue;
 			}
 		}						/* continuing data in existing file */
@@ -1387,10 +1616,312 @@ ReceiveAndUnpackTarFile(PGconn *conn, PGresult *res, int rownum)
 	if (copybuf != NULL)
 		PQfreemem(copybuf);
 
+	/*
+	 * In an incremental backup, remove what was left over from the previous
+	 * backup, such as the files of dropped relations.  pg_xlog was emptied
+	 * at the start, and may be receiving streamed WAL right now.
+	 */
+	if (incremental)
+	{
+		int			i;
+
+		qsort(received_paths, nreceived_paths, sizeof(char *), pg_qsort_strcmp);
+		RemoveUnreceivedFiles(current_path, basetablespace);
+
+		for (i = 0; i < nreceived_paths; i++)
+			pg_free(received_paths[i]);
+		nreceived_paths = 0;
+	}
+
 	if (basetablespace && writerecoveryconf)
 		WriteRecoveryConf();
 }
 
+/*
+ * Apply a piece of the contents of an incremental file, as described in
+ * replication/basebackup.h, to the file of the previous backup.
+ */
+static void
+ApplyIncrementalData(IncrementalFileState *state, FILE *file,
+					 const char *filename, char *data, int len)
+{
+	while (len > 0)
+	{
+		size_t		n;
+
+		if (state->hdrlen < sizeof(IncrementalFileHeader))
+		{
+			/* Still reading the header */
+			n = Min(len, sizeof(IncrementalFileHeader) - state->hdrlen);
+			memcpy((char *) &state->hdr + state->hdrlen, data, n);
+			state->hdrlen += n;
+
+			if (state->hdrlen == sizeof(IncrementalFileHeader))
+			{
+				state->hdr.magic = ntohl(state->hdr.magic);
+				state->hdr.blcksz = ntohl(state->hdr.blcksz);
+				state->hdr.nblocks = ntohl(state->hdr.nblocks);
+				state->hdr.nsent = ntohl(state->hdr.nsent);
+				state->hdr.flags = ntohl(state->hdr.flags);
+
+				if (state->hdr.magic != INCREMENTAL_FILE_MAGIC ||
+					state->hdr.nsent > state->hdr.nblocks)
+				{
+					fprintf(stderr, _("%s: invalid incremental file header for \"%s\"\n"),
+							progname, filename);
+					disconnect_and_exit(1);
+				}
+				if (state->hdr.blcksz != BLCKSZ)
+				{
+					fprintf(stderr, _("%s: incremental file \"%s\" has block size %u, expected %u\n"),
+							progname, filename, state->hdr.blcksz, BLCKSZ);
+					disconnect_and_exit(1);
+				}
+				state->blocks = pg_malloc(Max(state->hdr.nsent, 1) * sizeof(uint32));
+			}
+		}
+		else if (state->blockslen < state->hdr.nsent * sizeof(uint32))
+		{
+			/* Still reading the block numbers */
+			n = Min(len, state->hdr.nsent * sizeof(uint32) - state->blockslen);
+			memcpy((char *) state->blocks + state->blockslen, data, n);
+			state->blockslen += n;
+		}
+		else
+		{
+			/* Reading the blocks */
+			if (state->curblock >= state->hdr.nsent)
+			{
+				fprintf(stderr, _("%s: incremental file \"%s\" is too long\n"),
+						progname, filename);
+				disconnect_and_exit(1);
+			}
+			n = Min(len, BLCKSZ - state->blockbuflen);
+			memcpy(state->blockbuf + state->blockbuflen, data, n);
+			state->blockbuflen += n;
+
+			if (state->blockbuflen == BLCKSZ)
+			{
+				pgoff_t		offset = (pgoff_t) state->blocks[state->curblock] * BLCKSZ;
+
+				if (fseeko(file, offset, SEEK_SET) != 0 ||
+					fwrite(state->blockbuf, BLCKSZ, 1, file) != 1)
+				{
+					fprintf(stderr, _("%s: could not write to file \"%s\": %s\n"),
+							progname, filename, strerror(errno));
+					disconnect_and_exit(1);
+				}
+				state->curblock++;
+				state->blockbuflen = 0;
+			}
+		}
+
+		data += n;
+		len -= n;
+
+		/*
+		 * Once the block numbers are known, check them against the file of
+		 * the previous backup, and give it the new length.
+		 */
+		if (!state->checked &&
+			state->hdrlen == sizeof(IncrementalFileHeader) &&
+			state->blockslen == state->hdr.nsent * sizeof(uint32))
+		{
+			struct stat statbuf;
+			uint32		oldnblocks;
+			uint32		nnew = 0;
+			uint32		i;
+
+			if (fstat(fileno(file), &statbuf) != 0)
+			{
+				fprintf(stderr, _("%s: could not stat file \"%s\": %s\n"),
+						progname, filename, strerror(errno));
+				disconnect_and_exit(1);
+			}
+			oldnblocks = statbuf.st_size / BLCKSZ;
+
+			/*
+			 * The blocks past the end of the old file must all have been
+			 * sent.  They aren't if the previous backup is newer than the
+			 * relation's data, for example after the relation was truncated
+			 * and re-extended with pages not WAL-logged since.  When the
+			 * server used WAL summaries, the blocks not sent there are zeros,
+			 * which extending the file below provides.
+			 */
+			for (i = 0; i < state->hdr.nsent; i++)
+			{
+				state->blocks[i] = ntohl(state->blocks[i]);
+				if (state->blocks[i] >= state->hdr.nblocks ||
+					(i > 0 && state->blocks[i] <= state->blocks[i - 1]))
+				{
+					fprintf(stderr, _("%s: invalid block numbers in incremental file \"%s\"\n"),
+							progname, filename);
+					disconnect_and_exit(1);
+				}
+				if (state->blocks[i] >= oldnblocks)
+					nnew++;
+			}
+			if (!(state->hdr.flags & INCREMENTAL_FILE_SUMMARIZED) &&
+				oldnblocks < state->hdr.nblocks &&
+				nnew != state->hdr.nblocks - oldnblocks)
+			{
+				fprintf(stderr, _("%s: file \"%s\" of the previous backup is missing blocks, take a full backup\n"),
+						progname, filename);
+				disconnect_and_exit(1);
+			}
+
+			if (fflush(file) != 0 ||
+				ftruncate(fileno(file), (pgoff_t) state->hdr.nblocks * BLCKSZ) != 0)
+			{
+				fprintf(stderr, _("%s: could not truncate file \"%s\": %s\n"),
+						progname, filename, strerror(errno));
+				disconnect_and_exit(1);
+			}
+			state->checked = true;
+		}
+	}
+}
+
+/*
+ * Remember that path was received in an incremental backup.
+ */
+static void
+RecordReceivedPath(const char *path)
+{
+	if (nreceived_paths >= maxreceived_paths)
+	{
+		maxreceived_paths = Max(maxreceived_paths * 2, 1024);
+		received_paths = pg_realloc(received_paths,
+									maxreceived_paths * sizeof(char *));
+	}
+	received_paths[nreceived_paths++] = pg_strdup(path);
+}
+
+/*
+ * Remove the files and directories under path that weren't received in
+ * this incremental backup.  The top-level pg_xlog is left alone if skipxlog.
+ */
+static void
+RemoveUnreceivedFiles(const char *path, bool skipxlog)
+{
+	DIR		   *dir;
+	struct dirent *de;
+
+	dir = opendir(path);
+	if (dir == NULL)
+	{
+		fprintf(stderr, _("%s: could not open directory \"%s\": %s\n"),
+				progname, path, strerror(errno));
+		disconnect_and_exit(1);
+	}
+
+	while (errno = 0, (de = readdir(dir)) != NULL)
+	{
+		char		fn[MAXPGPATH];
+		char	   *key = fn;
+		struct stat statbuf;
+
+		if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+			continue;
+		if (skipxlog && strcmp(de->d_name, "pg_xlog") == 0)
+			continue;
+
+		snprintf(fn, sizeof(fn), "%s/%s", path, de->d_name);
+		if (lstat(fn, &statbuf) != 0)
+		{
+			fprintf(stderr, _("%s: could not stat file \"%s\": %s\n"),
+					progname, fn, strerror(errno));
+			disconnect_and_exit(1);
+		}
+
+		if (bsearch(&key, received_paths, nreceived_paths, sizeof(char *),
+					pg_qsort_strcmp) != NULL)
+		{
+			if (S_ISDIR(statbuf.st_mode))
+				RemoveUnreceivedFiles(fn, false);
+			continue;
+		}
+
+		if (verbose)
+			fprintf(stderr, _("%s: removing \"%s\"\n"), progname, fn);
+
+		if (S_ISDIR(statbuf.st_mode))
+		{
+			if (!rmtree(fn, true))
+			{
+				fprintf(stderr, _("%s: could not remove directory \"%s\"\n"),
+						progname, fn);
+				disconnect_and_exit(1);
+			}
+		}
+		else if (unlink(fn) != 0)
+		{
+			fprintf(stderr, _("%s: could not remove file \"%s\": %s\n"),
+					progname, fn, strerror(errno));
+			disconnect_and_exit(1);
+		}
+	}
+
+	if (errno)
+	{
+		fprintf(stderr, _("%s: could not read directory \"%s\": %s\n"),
+				progname, path, strerror(errno));
+		disconnect_and_exit(1);
+	}
+
+	closedir(dir);
+}
+
+/*
+ * Read the start of the backup to update incrementally from its
+ * backup_label, and empty its pg_xlog.
+ */
+static void
+ReadPreviousBackupStart(void)
+{
+	char		filename[MAXPGPATH];
+	char		line[MAXPGPATH];
+	FILE	   *lfp;
+	uint32		hi,
+				lo;
+	bool		found = false;
+
+	snprintf(filename, sizeof(filename), "%s/backup_label", basedir);
+	lfp = fopen(filename, "r");
+	if (lfp == NULL)
+	{
+		fprintf(stderr, _("%s: could not open file \"%s\": %s\n"),
+				progname, filename, strerror(errno));
+		fprintf(stderr, _("%s: an incremental backup requires a previous plain format backup that has not been started\n"),
+				progname);
+		exit(1);
+	}
+	while (fgets(line, sizeof(line), lfp) != NULL)
+	{
+		if (sscanf(line, "START WAL LOCATION: %X/%X", &hi, &lo) == 2)
+		{
+			found = true;
+			break;
+		}
+	}
+	fclose(lfp);
+	if (!found)
+	{
+		fprintf(stderr, _("%s: invalid data in file \"%s\"\n"),
+				progname, filename);
+		exit(1);
+	}
+	snprintf(incremental_start, sizeof(incremental_start), "%X/%X", hi, lo);
+
+	snprintf(filename, sizeof(filename), "%s/pg_xlog", basedir);
+	if (!rmtree(filename, false))
+	{
+		fprintf(stderr, _("%s: could not remove contents of directory \"%s\"\n"),
+				progname, filename);
+		exit(1);
+	}
+}
+
 /*
  * Escape a parameter value so that it can be used as part of a libpq
  * connection string, e.g. in:
@@ -1590,6 +2121,8 @@ BaseBackup(void)
 	char	   *basebkp;
 	char		escaped_label[MAXPGPATH];
 	char	   *maxrate_clause = NULL;
+	char	   *compress_clause = NULL;
+	char	   *incremental_clause = NULL;
 	int			i;
 	char		xlogstart[64];
 	char		xlogend[64];
@@ -1650,16 +2183,23 @@ BaseBackup(void)
 
 	if (maxrate > 0)
 		maxrate_clause = psprintf("MAX_RATE %u", maxrate);
+	if (servercompress)
+		compress_clause = psprintf("COMPRESS %d",
+								   compresslevel > 0 ? compresslevel : 6);
+	if (incremental)
+		incremental_clause = psprintf("INCREMENTAL '%s'", incremental_start);
 
 	basebkp =
-		psprintf("BASE_BACKUP LABEL '%s' %s %s %s %s %s %s",
+		psprintf("BASE_BACKUP LABEL '%s' %s %s %s %s %s %s %s %s",
 				 escaped_label,
 				 showprogress ? "PROGRESS" : "",
 				 includewal && !streamwal ? "WAL" : "",
 				 fastcheckpoint ? "FAST" : "",
 				 includewal ? "NOWAIT" : "",
 				 maxrate_clause ? maxrate_clause : "",
-				 format == 't' ? "TABLESPACE_MAP" : "");
+				 format == 't' ? "TABLESPACE_MAP" : "",
+				 compress_clause ? compress_clause : "",
+				 incremental_clause ? incremental_clause : "");
 
 	if (PQsendQuery(conn, basebkp) == 0)
 	{
@@ -1732,13 +2272,15 @@ BaseBackup(void)
 		/*
 		 * Verify tablespace directories are empty. Don't bother with the
 		 * first once since it can be relocated, and it will be checked before
-		 * we do anything anyway.
+		 * we do anything anyway.  In an incremental backup, they hold the
+		 * previous backup, unless the tablespace is new.
 		 */
 		if (format == 'p' && !PQgetisnull(res, i, 1))
 		{
 			char	   *path = (char *) get_tablespace_mapping(PQgetvalue(res, i, 1));
 
-			verify_dir_is_empty_or_create(path);
+			if (!incremental || pg_check_dir(path) == 0)
+				verify_dir_is_empty_or_create(path);
 		}
 	}
 
@@ -1771,7 +2313,14 @@ BaseBackup(void)
 	for (i = 0; i < PQntuples(res); i++)
 	{
 		if (format == 't')
-			ReceiveTarFile(conn, res, i);
+		{
+#ifdef HAVE_LIBZ
+			if (servercompress)
+				ReceiveCompressedTarFile(conn, res, i);
+			else
+#endif
+				ReceiveTarFile(conn, res, i);
+		}
 		else
 			ReceiveAndUnpackTarFile(conn, res, i);
 	}							/* Loop over all tablespaces */
@@ -1950,6 +2499,8 @@ main(int argc, char **argv)
 		{"verbose", no_argument, NULL, 'v'},
 		{"progress", no_argument, NULL, 'P'},
 		{"xlogdir", required_argument, NULL, 1},
+		{"server-compress", no_argument, NULL, 2},
+		{"incremental", no_argument, NULL, 3},
 		{NULL, 0, NULL, 0}
 	};
 	int			c;
@@ -2043,6 +2594,12 @@ main(int argc, char **argv)
 			case 1:
 				xlog_dir = pg_strdup(optarg);
 				break;
+			case 2:
+				servercompress = true;
+				break;
+			case 3:
+				incremental = true;
+				break;
 			case 'l':
 				label = pg_strdup(optarg);
 				break;
@@ -2155,6 +2712,36 @@ main(int argc, char **argv)
 		exit(1);
 	}
 
+	if (servercompress && compresslevel == 0)
+	{
+		fprintf(stderr,
+				_("%s: --server-compress requires --gzip or --compress\n"),
+				progname);
+		fprintf(stderr, _("Try \"%s --help\" for more information.\n"),
+				progname);
+		exit(1);
+	}
+
+	if (incremental && format != 'p')
+	{
+		fprintf(stderr,
+				_("%s: only plain mode backups can be incremental\n"),
+				progname);
+		fprintf(stderr, _("Try \"%s --help\" for more information.\n"),
+				progname);
+		exit(1);
+	}
+
+	if (incremental && strcmp(xlog_dir, "") != 0)
+	{
+		fprintf(stderr,
+				_("%s: --xlogdir cannot be used with --incremental\n"),
+				progname);
+		fprintf(stderr, _("Try \"%s --help\" for more information.\n"),
+				progname);
+		exit(1);
+	}
+
 	if (format != 'p' && streamwal)
 	{
 		fprintf(stderr,
@@ -2202,9 +2789,12 @@ main(int argc, char **argv)
 	/*
 	 * Verify that the target directory exists, or create it. For plaintext
 	 * backups, always require the directory. For tar backups, require it
-	 * unless we are writing to stdout.
+	 * unless we are writing to stdout.  An incremental backup updates the
+	 * previous backup in the directory instead.
 	 */
-	if (format == 'p' || strcmp(basedir, "-") != 0)
+	if (incremental)
+		ReadPreviousBackupStart();
+	else if (format == 'p' || strcmp(basedir, "-") != 0)
 		verify_dir_is_empty_or_create(basedir);
 
 	/* Create transaction log symlink, if required */
@@ -2,7 +2,7 @@ use strict;
 use warnings;
 use Cwd;
 use TestLib;
-use Test::More tests => 35;
+use Test::More tests => 38;
 
 program_help_ok('pg_basebackup');
 program_version_ok('pg_basebackup');
@@ -38,6 +38,13 @@ command_ok([ 'pg_basebackup', '-D', "$tempdir/backup" ],
 	'pg_basebackup runs');
 ok(-f "$tempdir/backup/PG_VERSION", 'backup was created');
 
+command_ok([ 'pg_basebackup', '-D', "$tempdir/backup", '--incremental' ],
+	'incremental backup updates previous backup');
+ok(-f "$tempdir/backup/PG_VERSION", 'backup is still there');
+command_fails(
+	[ 'pg_basebackup', '-D', "$tempdir/backup", '-Ft', '--incremental' ],
+	'incremental backup requires plain format');
+
 command_ok(
 	[   'pg_basebackup', '-D', "$tempdir/backup2", '--xlogdir',
 		"$tempdir/xlog2" ],
@@ -11,9 +11,16 @@
  * provides more flexibility, using callbacks to read/write data from the
  * underlying stream. The second API is a wrapper around fopen/gzopen and
  * friends, providing an interface similar to those, but abstracts away
- * the possible compression. Both APIs use libz for the compression, but
- * the second API uses gzip headers, so the resulting files can be easily
- * manipulated with the gzip utility.
+ * the possible compression. Both APIs support libz, LZ4 and Zstandard
+ * compression. The second API writes gzip files, LZ4 frames and Zstandard
+ * frames, so the resulting files can be easily manipulated with the gzip,
+ * lz4 and zstd utilities.
+ *
+ * When writing compressed data, the compression is done by a separate
+ * thread if we have threads, so that compressing the data overlaps with
+ * producing it. The data is handed to the thread in COMPRESS_PIPELINE_BUFSIZE
+ * chunks; a stream that's shorter than that is compressed by the caller
+ * without starting a thread at all.
  *
  * Compressor API
  * --------------
@@ -41,10 +48,10 @@
  *	libz's gzopen() APIs. It allows you to use the same functions for
  *	compressed and uncompressed streams. cfopen_read() first tries to open
  *	the file with given name, and if it fails, it tries to open the same
- *	file with the .gz suffix. cfopen_write() opens a file for writing, an
- *	extra argument specifies if the file should be compressed, and adds the
- *	.gz suffix to the filename if so. This allows you to easily handle both
- *	compressed and uncompressed files.
+ *	file with the .gz, .lz4 and .zst suffixes. cfopen_write() opens a file
+ *	for writing, extra arguments specify if and how the file should be
+ *	compressed, and add the matching suffix to the filename. This allows you
+ *	to easily handle both compressed and uncompressed files.
  *
  * IDENTIFICATION
  *	   src/bin/pg_dump/compress_io.c
@@ -53,10 +60,105 @@
  */
 #include "postgres_fe.h"
 
+#include <ctype.h>
+
 #include "compress_io.h"
 #include "parallel.h"
 #include "pg_backup_utils.h"
 
+#ifdef USE_LZ4
+#include <lz4frame.h>
+#endif
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
+/*
+ * Parallel pg_dump on Windows runs its workers as threads already, and
+ * exit_horribly() there assumes it's called from one of them, so keep it
+ * simple and compress in the caller's thread on Windows.
+ */
+#if defined(ENABLE_THREAD_SAFETY) && !defined(WIN32)
+#define USE_COMPRESS_THREAD
+#include <pthread.h>
+#endif
+
+/* translator: this is a module name */
+static const char *modulename = gettext_noop("compress_io");
+
+/*----------------------
+ * Compression pipeline
+ *----------------------
+ */
+
+/* Callback that compresses and writes out a chunk of data */
+typedef void (*ConsumeFunc) (void *arg, const char *data, size_t len);
+
+typedef struct CompressPipeline
+{
+	ConsumeFunc consume;
+	void	   *arg;
+
+#ifdef USE_COMPRESS_THREAD
+	char	   *bufs[COMPRESS_PIPELINE_NBUFS];
+	size_t		lens[COMPRESS_PIPELINE_NBUFS];
+	int			fill;			/* buffer being filled by the caller */
+	int			next;			/* next buffer for the thread to consume */
+	bool		started;		/* has the thread been started? */
+
+	/* these are protected by the mutex */
+	int			nfull;			/* number of buffers handed to the thread */
+	bool		done;			/* no more buffers will follow */
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	pthread_t	thread;
+#endif
+} CompressPipeline;
+
+static CompressPipeline *CreatePipeline(ConsumeFunc consume, void *arg);
+static void PipelineWrite(CompressPipeline *pipe, const char *data,
+			  size_t len);
+static void EndPipeline(CompressPipeline *pipe);
+
+/*----------------------
+ * LZ4 and Zstandard streams
+ *----------------------
+ */
+
+/* Callback that writes out a chunk of compressed data */
+typedef void (*EmitFunc) (void *arg, const char *data, size_t len);
+
+typedef struct StreamState
+{
+	CompressionAlgorithm alg;
+	bool		compress;		/* compressing, or decompressing? */
+	bool		begun;			/* frame header written? */
+	char	   *outbuf;			/* compressed output */
+	size_t		outbufsize;
+
+#ifdef USE_LZ4
+	LZ4F_preferences_t lz4prefs;
+	LZ4F_compressionContext_t lz4c;
+	LZ4F_decompressionContext_t lz4d;
+#endif
+#ifdef USE_ZSTD
+	ZSTD_CStream *zstdc;
+	ZSTD_DStream *zstdd;
+#endif
+} StreamState;
+
+#if defined(USE_LZ4) || defined(USE_ZSTD)
+static StreamState *InitStream(CompressionAlgorithm alg, bool compress,
+		   int level);
+static void StreamCompress(StreamState *st, const char *data, size_t len,
+			   EmitFunc emitF, void *arg);
+static void EndStreamCompress(StreamState *st, EmitFunc emitF, void *arg);
+static size_t StreamDecompress(StreamState *st, const char **in,
+				 size_t *inlen, char *out, size_t outlen);
+static void FreeStream(StreamState *st);
+#endif
+
 /*----------------------
  * Compressor API
  *----------------------
@@ -67,19 +169,18 @@ struct CompressorState
 {
 	CompressionAlgorithm comprAlg;
 	WriteFunc	writeF;
+	ArchiveHandle *AH;
+	CompressPipeline *pipeline; /* NULL if not compressing */
 
 #ifdef HAVE_LIBZ
 	z_streamp	zp;
 	char	   *zlibOut;
 	size_t		zlibOutSize;
 #endif
+	StreamState *stream;		/* for LZ4 and Zstandard */
 };
 
-/* translator: this is a module name */
-static const char *modulename = gettext_noop("compress_io");
-
-static void ParseCompressionOption(int compression, CompressionAlgorithm *alg,
-					   int *level);
+static void CompressorConsume(void *arg, const char *data, size_t len);
 
 /* Routines that support zlib compressed data I/O */
 #ifdef HAVE_LIBZ
@@ -92,64 +193,190 @@ static void WriteDataToArchiveZlib(ArchiveHandle *AH, CompressorState *cs,
 static void EndCompressorZlib(ArchiveHandle *AH, CompressorState *cs);
 #endif
 
+/* Routines that support LZ4 and Zstandard compressed data I/O */
+#if defined(USE_LZ4) || defined(USE_ZSTD)
+static void ReadDataFromArchiveStream(ArchiveHandle *AH,
+						  CompressionAlgorithm alg, ReadFunc readF);
+static void CompressorEmit(void *arg, const char *data, size_t len);
+#endif
+
 /* Routines that support uncompressed data I/O */
 static void ReadDataFromArchiveNone(ArchiveHandle *AH, ReadFunc readF);
 static void WriteDataToArchiveNone(ArchiveHandle *AH, CompressorState *cs,
 					   const char *data, size_t dLen);
 
 /*
- * Interprets a numeric 'compression' value. The algorithm implied by the
- * value (zlib or none at the moment), is returned in *alg, and the
- * zlib compression level in *level.
+ * Parses a compression option, as given to pg_dump -Z.  It's either a plain
+ * gzip compression level 0-9, 0 meaning no compression, or the name of a
+ * method (none, gzip, lz4 or zstd), optionally followed by a colon and a
+ * level.  Returns false if the option is invalid.
+ *
+ * A method given without a level gets the library's default level, which
+ * is Z_DEFAULT_COMPRESSION for gzip and 0 for LZ4 and Zstandard.
  */
-static void
-ParseCompressionOption(int compression, CompressionAlgorithm *alg, int *level)
+bool
+ParseCompressionOption(const char *option, CompressionAlgorithm *alg,
+					   int *level)
 {
-	if (compression == Z_DEFAULT_COMPRESSION ||
-		(compression > 0 && compression <= 9))
-		*alg = COMPR_ALG_LIBZ;
-	else if (compression == 0)
+	const char *sep;
+	size_t		namelen;
+	int			minlevel;
+	int			maxlevel;
+	char	   *endptr;
+	long		val;
+
+	if (isdigit((unsigned char) option[0]))
+	{
+		val = strtol(option, &endptr, 10);
+		if (*endptr != '\0' || val < 0 || val > 9)
+			return false;
+		*alg = (val == 0) ? COMPR_ALG_NONE : COMPR_ALG_LIBZ;
+		*level = (int) val;
+		return true;
+	}
+
+	sep = strchr(option, ':');
+	namelen = sep ? sep - option : strlen(option);
+
+	if (namelen == 4 && pg_strncasecmp(option, "none", namelen) == 0)
+	{
 		*alg = COMPR_ALG_NONE;
+		*level = 0;
+		minlevel = maxlevel = 0;
+	}
+	else if (namelen == 4 && pg_strncasecmp(option, "gzip", namelen) == 0)
+	{
+		*alg = COMPR_ALG_LIBZ;
+		*level = Z_DEFAULT_COMPRESSION;
+		minlevel = 1;
+		maxlevel = 9;
+	}
+	else if (namelen == 3 && pg_strncasecmp(option, "lz4", namelen) == 0)
+	{
+		*alg = COMPR_ALG_LZ4;
+		*level = 0;
+		minlevel = 0;
+		maxlevel = 12;
+	}
+	else if (namelen == 4 && pg_strncasecmp(option, "zstd", namelen) == 0)
+	{
+		*alg = COMPR_ALG_ZSTD;
+		*level = 0;
+		minlevel = 1;
+		maxlevel = 22;
+	}
 	else
+		return false;
+
+	if (sep == NULL)
+		return true;
+
+	if (*alg == COMPR_ALG_NONE || !isdigit((unsigned char) sep[1]))
+		return false;
+	val = strtol(sep + 1, &endptr, 10);
+	if (*endptr != '\0' || val < minlevel || val > maxlevel)
+		return false;
+	*level = (int) val;
+
+	return true;
+}
+
+/*
+ * Returns the name of a compression algorithm, as accepted by
+ * ParseCompressionOption().
+ */
+const char *
+CompressionAlgorithmName(CompressionAlgorithm alg)
+{
+	switch (alg)
 	{
-		exit_horribly(modulename, "invalid compression code: %d\n",
-					  compression);
-		*alg = COMPR_ALG_NONE;	/* keep compiler quiet */
+		case COMPR_ALG_NONE:
+			return "none";
+		case COMPR_ALG_LIBZ:
+			return "gzip";
+		case COMPR_ALG_LZ4:
+			return "lz4";
+		case COMPR_ALG_ZSTD:
+			return "zstd";
 	}
+	return "unknown";
+}
 
-	/* The level is just the passed-in value. */
-	if (level)
-		*level = compression;
+/*
+ * Is this installation built with support for the compression algorithm?
+ */
+bool
+CompressionAlgorithmSupported(CompressionAlgorithm alg)
+{
+	switch (alg)
+	{
+		case COMPR_ALG_NONE:
+			return true;
+		case COMPR_ALG_LIBZ:
+#ifdef HAVE_LIBZ
+			return true;
+#else
+			return false;
+#endif
+		case COMPR_ALG_LZ4:
+#ifdef USE_LZ4
+			return true;
+#else
+			return false;
+#endif
+		case COMPR_ALG_ZSTD:
+#ifdef USE_ZSTD
+			return true;
+#else
+			return false;
+#endif
+	}
+	return false;
 }
 
 /* Public interface routines */
 
-/* Allocate a new compressor */
+/*
+ * Allocate a new compressor. 'level' is the compression level, in the range
+ * accepted by ParseCompressionOption() for the algorithm.
+ */
 CompressorState *
-AllocateCompressor(int compression, WriteFunc writeF)
+AllocateCompressor(ArchiveHandle *AH, CompressionAlgorithm alg, int level,
+				   WriteFunc writeF)
 {
 	CompressorState *cs;
-	CompressionAlgorithm alg;
-	int			level;
-
-	ParseCompressionOption(compression, &alg, &level);
 
-#ifndef HAVE_LIBZ
-	if (alg == COMPR_ALG_LIBZ)
-		exit_horribly(modulename, "not built with zlib support\n");
-#endif
+	if (!CompressionAlgorithmSupported(alg))
+		exit_horribly(modulename, "not built with %s support\n",
+					  CompressionAlgorithmName(alg));
 
 	cs = (CompressorState *) pg_malloc0(sizeof(CompressorState));
 	cs->writeF = writeF;
 	cs->comprAlg = alg;
+	cs->AH = AH;
 
 	/*
 	 * Perform compression algorithm specific initialization.
 	 */
+	switch (alg)
+	{
+		case COMPR_ALG_NONE:
+			break;
+		case COMPR_ALG_LIBZ:
 #ifdef HAVE_LIBZ
-	if (alg == COMPR_ALG_LIBZ)
-		InitCompressorZlib(cs, level);
+			InitCompressorZlib(cs, level);
+#endif
+			break;
+		case COMPR_ALG_LZ4:
+		case COMPR_ALG_ZSTD:
+#if defined(USE_LZ4) || defined(USE_ZSTD)
+			cs->stream = InitStream(alg, true, level);
 #endif
+			break;
+	}
+
+	if (alg != COMPR_ALG_NONE)
+		cs->pipeline = CreatePipeline(CompressorConsume, cs);
 
 	return cs;
 }
@@ -159,21 +386,29 @@ AllocateCompressor(int compression, WriteFunc writeF)
  * out with ahwrite().
  */
 void
-ReadDataFromArchive(ArchiveHandle *AH, int compression, ReadFunc readF)
+ReadDataFromArchive(ArchiveHandle *AH, CompressionAlgorithm alg,
+					ReadFunc readF)
 {
-	CompressionAlgorithm alg;
+	if (!CompressionAlgorithmSupported(alg))
+		exit_horribly(modulename, "not built with %s support\n",
+					  CompressionAlgorithmName(alg));
 
-	ParseCompressionOption(compression, &alg, NULL);
-
-	if (alg == COMPR_ALG_NONE)
-		ReadDataFromArchiveNone(AH, readF);
-	if (alg == COMPR_ALG_LIBZ)
+	switch (alg)
 	{
+		case COMPR_ALG_NONE:
+			ReadDataFromArchiveNone(AH, readF);
+			break;
+		case COMPR_ALG_LIBZ:
 #ifdef HAVE_LIBZ
-		ReadDataFromArchiveZlib(AH, readF);
-#else
-		exit_horribly(modulename, "not built with zlib support\n");
+			ReadDataFromArchiveZlib(AH, readF);
+#endif
+			break;
+		case COMPR_ALG_LZ4:
+		case COMPR_ALG_ZSTD:
+#if defined(USE_LZ4) || defined(USE_ZSTD)
+			ReadDataFromArchiveStream(AH, alg, readF);
 #endif
+			break;
 	}
 }
 
@@ -187,20 +422,10 @@ WriteDataToArchive(ArchiveHandle *AH, CompressorState *cs,
 	/* Are we aborting? */
 	checkAborting(AH);
 
-	switch (cs->comprAlg)
-	{
-		case COMPR_ALG_LIBZ:
-#ifdef HAVE_LIBZ
-			WriteDataToArchiveZlib(AH, cs, data, dLen);
-#else
-			exit_horribly(modulename, "not built with zlib support\n");
-#endif
-			break;
-		case COMPR_ALG_NONE:
-			WriteDataToArchiveNone(AH, cs, data, dLen);
-			break;
-	}
-	return;
+	if (cs->pipeline)
+		PipelineWrite(cs->pipeline, data, dLen);
+	else
+		WriteDataToArchiveNone(AH, cs, data, dLen);
 }
 
 /*
@@ -209,13 +434,51 @@ WriteDataToArchive(ArchiveHandle *AH, CompressorState *cs,
 void
 EndCompressor(ArchiveHandle *AH, CompressorState *cs)
 {
+	/* Wait for the compression thread to finish */
+	if (cs->pipeline)
+		EndPipeline(cs->pipeline);
+
 #ifdef HAVE_LIBZ
 	if (cs->comprAlg == COMPR_ALG_LIBZ)
 		EndCompressorZlib(AH, cs);
+#endif
+#if defined(USE_LZ4) || defined(USE_ZSTD)
+	if (cs->stream)
+	{
+		EndStreamCompress(cs->stream, CompressorEmit, cs);
+		FreeStream(cs->stream);
+	}
 #endif
 	free(cs);
 }
 
+/*
+ * Compresses a chunk of data and passes it to the write function. This is
+ * called by the compression thread, if there is one.
+ */
+static void
+CompressorConsume(void *arg, const char *data, size_t len)
+{
+	CompressorState *cs = (CompressorState *) arg;
+
+	switch (cs->comprAlg)
+	{
+		case COMPR_ALG_NONE:
+			break;
+		case COMPR_ALG_LIBZ:
+#ifdef HAVE_LIBZ
+			WriteDataToArchiveZlib(cs->AH, cs, data, len);
+#endif
+			break;
+		case COMPR_ALG_LZ4:
+		case COMPR_ALG_ZSTD:
+#if defined(USE_LZ4) || defined(USE_ZSTD)
+			StreamCompress(cs->stream, data, len, CompressorEmit, cs);
+#endif
+			break;
+	}
+}
+
 /* Private routines, specific to each compression method. */
 
 #ifdef HAVE_LIBZ
@@ -398,6 +661,339 @@ ReadDataFromArchiveZlib(ArchiveHandle *AH, ReadFunc readF)
 #endif   /* HAVE_LIBZ */
 
 
+#if defined(USE_LZ4) || defined(USE_ZSTD)
+/*
+ * Functions for LZ4 and Zstandard compressed output.
+ */
+
+static void
+CompressorEmit(void *arg, const char *data, size_t len)
+{
+	CompressorState *cs = (CompressorState *) arg;
+
+	cs->writeF(cs->AH, data, len);
+}
+
+static void
+ReadDataFromArchiveStream(ArchiveHandle *AH, CompressionAlgorithm alg,
+						  ReadFunc readF)
+{
+	StreamState *st;
+	size_t		cnt;
+	char	   *buf;
+	size_t		buflen;
+	char	   *out;
+	const char *in;
+	size_t		inlen;
+	size_t		outlen;
+
+	st = InitStream(alg, false, 0);
+
+	buf = pg_malloc(COMPRESS_IN_SIZE);
+	buflen = COMPRESS_IN_SIZE;
+
+	out = pg_malloc(COMPRESS_IN_SIZE + 1);
+
+	in = buf;
+	while ((cnt = readF(AH, &buf, &buflen)))
+	{
+		/* Are we aborting? */
+		checkAborting(AH);
+
+		in = buf;
+		inlen = cnt;
+		while (inlen > 0)
+		{
+			outlen = StreamDecompress(st, &in, &inlen, out, COMPRESS_IN_SIZE);
+			out[outlen] = '\0';
+			ahwrite(out, 1, outlen, AH);
+		}
+	}
+
+	/* Drain any output the library is still holding on to */
+	inlen = 0;
+	while ((outlen = StreamDecompress(st, &in, &inlen, out,
+									  COMPRESS_IN_SIZE)) > 0)
+	{
+		out[outlen] = '\0';
+		ahwrite(out, 1, outlen, AH);
+	}
+
+	FreeStream(st);
+	free(buf);
+	free(out);
+}
+
+static StreamState *
+InitStream(CompressionAlgorithm alg, bool compress, int level)
+{
+	StreamState *st = pg_malloc0(sizeof(StreamState));
+
+	st->alg = alg;
+	st->compress = compress;
+
+	switch (alg)
+	{
+		case COMPR_ALG_LZ4:
+#ifdef USE_LZ4
+			if (compress)
+			{
+				LZ4F_errorCode_t err;
+
+				st->lz4prefs.compressionLevel = level;
+				err = LZ4F_createCompressionContext(&st->lz4c, LZ4F_VERSION);
+				if (LZ4F_isError(err))
+					exit_horribly(modulename,
+							"could not initialize compression library: %s\n",
+								  LZ4F_getErrorName(err));
+				st->outbufsize = LZ4F_compressBound(COMPRESS_IN_SIZE,
+													&st->lz4prefs);
+			}
+			else
+			{
+				LZ4F_errorCode_t err;
+
+				err = LZ4F_createDecompressionContext(&st->lz4d, LZ4F_VERSION);
+				if (LZ4F_isError(err))
+					exit_horribly(modulename,
+							"could not initialize compression library: %s\n",
+								  LZ4F_getErrorName(err));
+			}
+#endif
+			break;
+		case COMPR_ALG_ZSTD:
+#ifdef USE_ZSTD
+			if (compress)
+			{
+				size_t		res;
+
+				st->zstdc = ZSTD_createCStream();
+				if (st->zstdc == NULL)
+					exit_horribly(modulename,
+						"could not initialize compression library: out of memory\n");
+				res = ZSTD_initCStream(st->zstdc, level);
+				if (ZSTD_isError(res))
+					exit_horribly(modulename,
+							"could not initialize compression library: %s\n",
+								  ZSTD_getErrorName(res));
+				st->outbufsize = ZSTD_CStreamOutSize();
+			}
+			else
+			{
+				size_t		res;
+
+				st->zstdd = ZSTD_createDStream();
+				if (st->zstdd == NULL)
+					exit_horribly(modulename,
+						"could not initialize compression library: out of memory\n");
+				res = ZSTD_initDStream(st->zstdd);
+				if (ZSTD_isError(res))
+					exit_horribly(modulename,
+							"could not initialize compression library: %s\n",
+								  ZSTD_getErrorName(res));
+			}
+#endif
+			break;
+		default:
+			exit_horribly(modulename, "not built with %s support\n",
+						  CompressionAlgorithmName(alg));
+	}
+
+	if (compress)
+		st->outbuf = pg_malloc(st->outbufsize);
+
+	return st;
+}
+
+/*
+ * Compresses 'len' bytes of 'data', passing the compressed output to emitF.
+ * Like the zlib code, this never emits a zero-length chunk, since that is the
+ * EOF marker in the custom format.
+ */
+static void
+StreamCompress(StreamState *st, const char *data, size_t len,
+			   EmitFunc emitF, void *arg)
+{
+#ifdef USE_LZ4
+	if (st->alg == COMPR_ALG_LZ4)
+	{
+		size_t		res;
+
+		if (!st->begun)
+		{
+			res = LZ4F_compressBegin(st->lz4c, st->outbuf, st->outbufsize,
+									 &st->lz4prefs);
+			if (LZ4F_isError(res))
+				exit_horribly(modulename, "could not compress data: %s\n",
+							  LZ4F_getErrorName(res));
+			if (res > 0)
+				emitF(arg, st->outbuf, res);
+			st->begun = true;
+		}
+
+		/* outbuf is sized for COMPRESS_IN_SIZE bytes of input at a time */
+		while (len > 0)
+		{
+			size_t		chunk = Min(len, COMPRESS_IN_SIZE);
+
+			res = LZ4F_compressUpdate(st->lz4c, st->outbuf, st->outbufsize,
+									  data, chunk, NULL);
+			if (LZ4F_isError(res))
+				exit_horribly(modulename, "could not compress data: %s\n",
+							  LZ4F_getErrorName(res));
+			if (res > 0)
+				emitF(arg, st->outbuf, res);
+			data += chunk;
+			len -= chunk;
+		}
+	}
+#endif
+#ifdef USE_ZSTD
+	if (st->alg == COMPR_ALG_ZSTD)
+	{
+		ZSTD_inBuffer input;
+		ZSTD_outBuffer output;
+		size_t		res;
+
+		input.src = data;
+		input.size = len;
+		input.pos = 0;
+		while (input.pos < input.size)
+		{
+			output.dst = st->outbuf;
+			output.size = st->outbufsize;
+			output.pos = 0;
+			res = ZSTD_compressStream(st->zstdc, &output, &input);
+			if (ZSTD_isError(res))
+				exit_horribly(modulename, "could not compress data: %s\n",
+							  ZSTD_getErrorName(res));
+			if (output.pos > 0)
+				emitF(arg, st->outbuf, output.pos);
+		}
+	}
+#endif
+}
+
+/*
+ * Finishes the compressed frame, passing the remaining output to emitF.
+ */
+static void
+EndStreamCompress(StreamState *st, EmitFunc emitF, void *arg)
+{
+#ifdef USE_LZ4
+	if (st->alg == COMPR_ALG_LZ4)
+	{
+		size_t		res;
+
+		/* Write the header, if no data was written at all */
+		if (!st->begun)
+			StreamCompress(st, NULL, 0, emitF, arg);
+
+		res = LZ4F_compressEnd(st->lz4c, st->outbuf, st->outbufsize, NULL);
+		if (LZ4F_isError(res))
+			exit_horribly(modulename, "could not compress data: %s\n",
+						  LZ4F_getErrorName(res));
+		if (res > 0)
+			emitF(arg, st->outbuf, res);
+	}
+#endif
+#ifdef USE_ZSTD
+	if (st->alg == COMPR_ALG_ZSTD)
+	{
+		ZSTD_outBuffer output;
+		size_t		res;
+
+		do
+		{
+			output.dst = st->outbuf;
+			output.size = st->outbufsize;
+			output.pos = 0;
+			res = ZSTD_endStream(st->zstdc, &output);
+			if (ZSTD_isError(res))
+				exit_horribly(modulename, "could not compress data: %s\n",
+							  ZSTD_getErrorName(res));
+			if (output.pos > 0)
+				emitF(arg, st->outbuf, output.pos);
+		} while (res != 0);
+	}
+#endif
+}
+
+/*
+ * Decompresses from *in, of length *inlen, into 'out', which has room for
+ * 'outlen' bytes. *in and *inlen are advanced past the input consumed, and
+ * the number of bytes of output is returned. The library may consume input
+ * without producing any output yet, or produce output from input it has
+ * buffered before, so callers should keep calling this until all the input
+ * has been consumed and it returns 0.
+ */
+static size_t
+StreamDecompress(StreamState *st, const char **in, size_t *inlen,
+				 char *out, size_t outlen)
+{
+#ifdef USE_LZ4
+	if (st->alg == COMPR_ALG_LZ4)
+	{
+		size_t		dstsize = outlen;
+		size_t		srcsize = *inlen;
+		size_t		res;
+
+		res = LZ4F_decompress(st->lz4d, out, &dstsize, *in, &srcsize, NULL);
+		if (LZ4F_isError(res))
+			exit_horribly(modulename, "could not uncompress data: %s\n",
+						  LZ4F_getErrorName(res));
+		*in += srcsize;
+		*inlen -= srcsize;
+		return dstsize;
+	}
+#endif
+#ifdef USE_ZSTD
+	if (st->alg == COMPR_ALG_ZSTD)
+	{
+		ZSTD_inBuffer input;
+		ZSTD_outBuffer output;
+		size_t		res;
+
+		input.src = *in;
+		input.size = *inlen;
+		input.pos = 0;
+		output.dst = out;
+		output.size = outlen;
+		output.pos = 0;
+		res = ZSTD_decompressStream(st->zstdd, &output, &input);
+		if (ZSTD_isError(res))
+			exit_horribly(modulename, "could not uncompress data: %s\n",
+						  ZSTD_getErrorName(res));
+		*in += input.pos;
+		*inlen -= input.pos;
+		return output.pos;
+	}
+#endif
+	return 0;
+}
+
+static void
+FreeStream(StreamState *st)
+{
+#ifdef USE_LZ4
+	if (st->lz4c)
+		LZ4F_freeCompressionContext(st->lz4c);
+	if (st->lz4d)
+		LZ4F_freeDecompressionContext(st->lz4d);
+#endif
+#ifdef USE_ZSTD
+	if (st->zstdc)
+		ZSTD_freeCStream(st->zstdc);
+	if (st->zstdd)
+		ZSTD_freeDStream(st->zstdd);
+#endif
+	if (st->outbuf)
+		free(st->outbuf);
+	free(st);
+}
+#endif   /* USE_LZ4 || USE_ZSTD */
+
+
 /*
  * Functions for uncompressed output.
  */
@@ -432,6 +1028,169 @@ WriteDataToArchiveNone(ArchiveHandle *AH, CompressorState *cs,
 }
 
 
+/*----------------------
+ * Compression pipeline
+ *----------------------
+ */
+
+#ifdef USE_COMPRESS_THREAD
+static void *PipelineThread(void *arg);
+static void PipelineHandOver(CompressPipeline *pipe);
+#endif
+
+/*
+ * Creates a pipeline, which passes all data written to it to 'consume',
+ * in a separate thread if we have threads.
+ */
+static CompressPipeline *
+CreatePipeline(ConsumeFunc consume, void *arg)
+{
+	CompressPipeline *pipe = pg_malloc0(sizeof(CompressPipeline));
+
+	pipe->consume = consume;
+	pipe->arg = arg;
+#ifdef USE_COMPRESS_THREAD
+	pipe->bufs[0] = pg_malloc(COMPRESS_PIPELINE_BUFSIZE);
+#endif
+
+	return pipe;
+}
+
+static void
+PipelineWrite(CompressPipeline *pipe, const char *data, size_t len)
+{
+#ifdef USE_COMPRESS_THREAD
+	while (len > 0)
+	{
+		size_t		n;
+
+		n = Min(len, COMPRESS_PIPELINE_BUFSIZE - pipe->lens[pipe->fill]);
+		memcpy(pipe->bufs[pipe->fill] + pipe->lens[pipe->fill], data, n);
+		pipe->lens[pipe->fill] += n;
+		data += n;
+		len -= n;
+
+		if (pipe->lens[pipe->fill] == COMPRESS_PIPELINE_BUFSIZE)
+			PipelineHandOver(pipe);
+	}
+#else
+	pipe->consume(pipe->arg, data, len);
+#endif
+}
+
+/*
+ * Passes any remaining data to 'consume', waits for the thread to finish,
+ * and frees the pipeline. After this, the caller can safely touch the
+ * compression state again.
+ */
+static void
+EndPipeline(CompressPipeline *pipe)
+{
+#ifdef USE_COMPRESS_THREAD
+	int			i;
+
+	if (!pipe->started)
+	{
+		/* Short stream, never started the thread */
+		if (pipe->lens[0] > 0)
+			pipe->consume(pipe->arg, pipe->bufs[0], pipe->lens[0]);
+	}
+	else
+	{
+		pthread_mutex_lock(&pipe->mutex);
+		if (pipe->lens[pipe->fill] > 0)
+			pipe->nfull++;
+		pipe->done = true;
+		pthread_cond_signal(&pipe->cond);
+		pthread_mutex_unlock(&pipe->mutex);
+
+		pthread_join(pipe->thread, NULL);
+		pthread_mutex_destroy(&pipe->mutex);
+		pthread_cond_destroy(&pipe->cond);
+	}
+
+	for (i = 0; i < COMPRESS_PIPELINE_NBUFS; i++)
+	{
+		if (pipe->bufs[i])
+			free(pipe->bufs[i]);
+	}
+#endif
+	free(pipe);
+}
+
+#ifdef USE_COMPRESS_THREAD
+/*
+ * Hands the buffer the caller has filled to the thread, starting the thread
+ * if this is the first one, and waits for a free buffer to fill next.
+ */
+static void
+PipelineHandOver(CompressPipeline *pipe)
+{
+	if (!pipe->started)
+	{
+		int			i;
+		int			err;
+
+		for (i = 1; i < COMPRESS_PIPELINE_NBUFS; i++)
+			pipe->bufs[i] = pg_malloc(COMPRESS_PIPELINE_BUFSIZE);
+
+		pthread_mutex_init(&pipe->mutex, NULL);
+		pthread_cond_init(&pipe->cond, NULL);
+		err = pthread_create(&pipe->thread, NULL, PipelineThread, pipe);
+		if (err != 0)
+			exit_horribly(modulename,
+						  "could not create compression thread: %s\n",
+						  strerror(err));
+		pipe->started = true;
+	}
+
+	pthread_mutex_lock(&pipe->mutex);
+	pipe->nfull++;
+	pthread_cond_signal(&pipe->cond);
+	while (pipe->nfull == COMPRESS_PIPELINE_NBUFS)
+		pthread_cond_wait(&pipe->cond, &pipe->mutex);
+	pthread_mutex_unlock(&pipe->mutex);
+
+	pipe->fill = (pipe->fill + 1) % COMPRESS_PIPELINE_NBUFS;
+	pipe->lens[pipe->fill] = 0;
+}
+
+/*
+ * Main loop of the compression thread. Errors are reported with
+ * exit_horribly(), which exits the whole process.
+ */
+static void *
+PipelineThread(void *arg)
+{
+	CompressPipeline *pipe = (CompressPipeline *) arg;
+
+	for (;;)
+	{
+		pthread_mutex_lock(&pipe->mutex);
+		while (pipe->nfull == 0 && !pipe->done)
+			pthread_cond_wait(&pipe->cond, &pipe->mutex);
+		if (pipe->nfull == 0)
+		{
+			pthread_mutex_unlock(&pipe->mutex);
+			break;
+		}
+		pthread_mutex_unlock(&pipe->mutex);
+
+		pipe->consume(pipe->arg, pipe->bufs[pipe->next],
+					  pipe->lens[pipe->next]);
+
+		pthread_mutex_lock(&pipe->mutex);
+		pipe->next = (pipe->next + 1) % COMPRESS_PIPELINE_NBUFS;
+		pipe->nfull--;
+		pthread_cond_signal(&pipe->cond);
+		pthread_mutex_unlock(&pipe->mutex);
+	}
+
+	return NULL;
+}
+#endif   /* USE_COMPRESS_THREAD */
+
+
 /*----------------------
  * Compressed stream API
  *----------------------
@@ -440,6 +1199,10 @@ WriteDataToArchiveNone(ArchiveHandle *AH, CompressorState *cs,
 /*
  * cfp represents an open stream, wrapping the underlying FILE or gzFile
  * pointer. This is opaque to the callers.
+ *
+ * LZ4 and Zstandard streams are read and written through uncompressedfp,
+ * with their compression state in 'stream'. Data written to a compressed
+ * stream goes through 'pipeline' to be compressed.
  */
 struct cfp
 {
@@ -447,11 +1210,23 @@ struct cfp
 #ifdef HAVE_LIBZ
 	gzFile		compressedfp;
 #endif
+	CompressionAlgorithm alg;
+	CompressPipeline *pipeline;
+	StreamState *stream;
+
+	/* Compressed input read from uncompressedfp, for LZ4 and Zstandard */
+	char	   *inbuf;
+	const char *inptr;
+	size_t		inlen;
+	bool		ineof;			/* reached end of uncompressedfp? */
+	bool		eof;			/* did cfread() reach end of stream? */
 };
 
-#ifdef HAVE_LIBZ
-static int	hasSuffix(const char *filename, const char *suffix);
+static void cfConsume(void *arg, const char *data, size_t len);
+#if defined(USE_LZ4) || defined(USE_ZSTD)
+static void cfEmit(void *arg, const char *data, size_t len);
 #endif
+static int	hasSuffix(const char *filename, const char *suffix);
 
 /* free() without changing errno; useful in several places below */
 static void
@@ -463,38 +1238,65 @@ free_keep_errno(void *p)
 	errno = save_errno;
 }
 
+/*
+ * Returns the file name suffix used for files compressed with 'alg',
+ * or an empty string for COMPR_ALG_NONE.
+ */
+const char *
+CompressionSuffix(CompressionAlgorithm alg)
+{
+	switch (alg)
+	{
+		case COMPR_ALG_NONE:
+			return "";
+		case COMPR_ALG_LIBZ:
+			return ".gz";
+		case COMPR_ALG_LZ4:
+			return ".lz4";
+		case COMPR_ALG_ZSTD:
+			return ".zst";
+	}
+	return "";
+}
+
 /*
  * Open a file for reading. 'path' is the file to open, and 'mode' should
  * be either "r" or "rb".
  *
- * If the file at 'path' does not exist, we append the ".gz" suffix (if 'path'
- * doesn't already have it) and try again. So if you pass "foo" as 'path',
- * this will open either "foo" or "foo.gz".
+ * If the file at 'path' does not exist, we append the ".gz", ".lz4" and
+ * ".zst" suffixes (if 'path' doesn't already have one of them) and try
+ * again, for each compression method this installation supports. So if you
+ * pass "foo" as 'path', this will open "foo", "foo.gz", "foo.lz4" or
+ * "foo.zst".
  *
  * On failure, return NULL with an error code in errno.
  */
 cfp *
 cfopen_read(const char *path, const char *mode)
 {
+	static const CompressionAlgorithm algs[] = {
+		COMPR_ALG_LIBZ, COMPR_ALG_LZ4, COMPR_ALG_ZSTD
+	};
 	cfp		   *fp;
+	int			i;
 
-#ifdef HAVE_LIBZ
-	if (hasSuffix(path, ".gz"))
-		fp = cfopen(path, mode, 1);
-	else
-#endif
+	for (i = 0; i < lengthof(algs); i++)
 	{
-		fp = cfopen(path, mode, 0);
-#ifdef HAVE_LIBZ
-		if (fp == NULL)
-		{
-			char	   *fname;
+		if (hasSuffix(path, CompressionSuffix(algs[i])))
+			return cfopen(path, mode, algs[i], 0);
+	}
 
-			fname = psprintf("%s.gz", path);
-			fp = cfopen(fname, mode, 1);
-			free_keep_errno(fname);
-		}
-#endif
+	fp = cfopen(path, mode, COMPR_ALG_NONE, 0);
+	for (i = 0; fp == NULL && i < lengthof(algs); i++)
+	{
+		char	   *fname;
+
+		if (!CompressionAlgorithmSupported(algs[i]))
+			continue;
+
+		fname = psprintf("%s%s", path, CompressionSuffix(algs[i]));
+		fp = cfopen(fname, mode, algs[i], 0);
+		free_keep_errno(fname);
 	}
 	return fp;
 }
@@ -504,77 +1306,91 @@ cfopen_read(const char *path, const char *mode)
  * be a filemode as accepted by fopen() and gzopen() that indicates writing
  * ("w", "wb", "a", or "ab").
  *
- * If 'compression' is non-zero, a gzip compressed stream is opened, and
- * 'compression' indicates the compression level used. The ".gz" suffix
- * is automatically added to 'path' in that case.
+ * If 'alg' is not COMPR_ALG_NONE, a compressed stream is opened, and
+ * 'level' indicates the compression level used. The suffix for the
+ * compression method is automatically added to 'path' in that case.
  *
  * On failure, return NULL with an error code in errno.
  */
 cfp *
-cfopen_write(const char *path, const char *mode, int compression)
+cfopen_write(const char *path, const char *mode,
+			 CompressionAlgorithm alg, int level)
 {
 	cfp		   *fp;
 
-	if (compression == 0)
-		fp = cfopen(path, mode, 0);
+	if (alg == COMPR_ALG_NONE)
+		fp = cfopen(path, mode, alg, 0);
 	else
 	{
-#ifdef HAVE_LIBZ
 		char	   *fname;
 
-		fname = psprintf("%s.gz", path);
-		fp = cfopen(fname, mode, compression);
+		fname = psprintf("%s%s", path, CompressionSuffix(alg));
+		fp = cfopen(fname, mode, alg, level);
 		free_keep_errno(fname);
-#else
-		exit_horribly(modulename, "not built with zlib support\n");
-		fp = NULL;				/* keep compiler quiet */
-#endif
 	}
 	return fp;
 }
 
 /*
- * Opens file 'path' in 'mode'. If 'compression' is non-zero, the file
- * is opened with libz gzopen(), otherwise with plain fopen().
+ * Opens file 'path' in 'mode'. If 'alg' is COMPR_ALG_LIBZ, the file is
+ * opened with libz gzopen(), otherwise with plain fopen(). 'level' is the
+ * compression level, if writing.
  *
  * On failure, return NULL with an error code in errno.
  */
 cfp *
-cfopen(const char *path, const char *mode, int compression)
+cfopen(const char *path, const char *mode, CompressionAlgorithm alg,
+	   int level)
 {
-	cfp		   *fp = pg_malloc(sizeof(cfp));
+	cfp		   *fp;
 
-	if (compression != 0)
+	if (!CompressionAlgorithmSupported(alg))
+		exit_horribly(modulename, "not built with %s support\n",
+					  CompressionAlgorithmName(alg));
+
+	fp = pg_malloc0(sizeof(cfp));
+	fp->alg = alg;
+
+	if (alg == COMPR_ALG_LIBZ)
 	{
 #ifdef HAVE_LIBZ
 		char		mode_compression[32];
 
-		snprintf(mode_compression, sizeof(mode_compression), "%s%d",
-				 mode, compression);
+		if (level == Z_DEFAULT_COMPRESSION)
+			snprintf(mode_compression, sizeof(mode_compression), "%s", mode);
+		else
+			snprintf(mode_compression, sizeof(mode_compression), "%s%d",
+					 mode, level);
 		fp->compressedfp = gzopen(path, mode_compression);
-		fp->uncompressedfp = NULL;
 		if (fp->compressedfp == NULL)
 		{
 			free_keep_errno(fp);
-			fp = NULL;
+			return NULL;
 		}
-#else
-		exit_horribly(modulename, "not built with zlib support\n");
 #endif
 	}
 	else
 	{
-#ifdef HAVE_LIBZ
-		fp->compressedfp = NULL;
-#endif
 		fp->uncompressedfp = fopen(path, mode);
 		if (fp->uncompressedfp == NULL)
 		{
 			free_keep_errno(fp);
-			fp = NULL;
+			return NULL;
 		}
 	}
 
+#if defined(USE_LZ4) || defined(USE_ZSTD)
+	if (alg == COMPR_ALG_LZ4 || alg == COMPR_ALG_ZSTD)
+	{
+		fp->stream = InitStream(alg, mode[0] != 'r', level);
+		if (mode[0] == 'r')
+			fp->inbuf = pg_malloc(COMPRESS_IN_SIZE);
+	}
+#endif
+
+	if (alg != COMPR_ALG_NONE && mode[0] != 'r')
+		fp->pipeline = CreatePipeline(cfConsume, fp);
+
 	return fp;
 }
 
@@ -587,6 +1403,39 @@ cfread(void *ptr, int size, cfp *fp)
 	if (size == 0)
 		return 0;
 
+#if defined(USE_LZ4) || defined(USE_ZSTD)
+	if (fp->stream)
+	{
+		ret = 0;
+		while (ret < size)
+		{
+			size_t		n;
+
+			if (fp->inlen == 0 && !fp->ineof)
+			{
+				fp->inlen = fread(fp->inbuf, 1, COMPRESS_IN_SIZE,
+								  fp->uncompressedfp);
+				fp->inptr = fp->inbuf;
+				if (fp->inlen < COMPRESS_IN_SIZE)
+				{
+					if (ferror(fp->uncompressedfp))
+						READ_ERROR_EXIT(fp->uncompressedfp);
+					fp->ineof = true;
+				}
+			}
+
+			n = StreamDecompress(fp->stream, &fp->inptr, &fp->inlen,
+								 (char *) ptr + ret, size - ret);
+			ret += n;
+			if (n == 0 && fp->inlen == 0 && fp->ineof)
+			{
+				fp->eof = true;
+				break;
+			}
+		}
+	}
+	else
+#endif
 #ifdef HAVE_LIBZ
 	if (fp->compressedfp)
 	{
@@ -605,15 +1454,20 @@ cfread(void *ptr, int size, cfp *fp)
 	return ret;
 }
 
+/*
+ * Writes 'size' bytes to the stream. Compressed data is compressed and
+ * written out asynchronously, and errors doing so are reported by
+ * exit_horribly(), so for a compressed stream this always returns 'size'.
+ */
 int
 cfwrite(const void *ptr, int size, cfp *fp)
 {
-#ifdef HAVE_LIBZ
-	if (fp->compressedfp)
-		return gzwrite(fp->compressedfp, ptr, size);
-	else
-#endif
-		return fwrite(ptr, 1, size, fp->uncompressedfp);
+	if (fp->pipeline)
+	{
+		PipelineWrite(fp->pipeline, ptr, size);
+		return size;
+	}
+	return fwrite(ptr, 1, size, fp->uncompressedfp);
 }
 
 int
@@ -621,6 +1475,18 @@ cfgetc(cfp *fp)
 {
 	int			ret;
 
+#if defined(USE_LZ4) || defined(USE_ZSTD)
+	if (fp->stream)
+	{
+		unsigned char c;
+
+		if (cfread(&c, 1, fp) != 1)
+			exit_horribly(modulename,
+						  "could not read from input file: end of file\n");
+		ret = c;
+	}
+	else
+#endif
 #ifdef HAVE_LIBZ
 	if (fp->compressedfp)
 	{
@@ -649,6 +1515,26 @@ cfgetc(cfp *fp)
 char *
 cfgets(cfp *fp, char *buf, int len)
 {
+#if defined(USE_LZ4) || defined(USE_ZSTD)
+	if (fp->stream)
+	{
+		int			i = 0;
+
+		/* Same semantics as fgets(), reading a byte at a time */
+		while (i < len - 1)
+		{
+			if (cfread(&buf[i], 1, fp) != 1)
+				break;
+			if (buf[i++] == '\n')
+				break;
+		}
+		if (i == 0)
+			return NULL;
+		buf[i] = '\0';
+		return buf;
+	}
+	else
+#endif
 #ifdef HAVE_LIBZ
 	if (fp->compressedfp)
 		return gzgets(fp->compressedfp, buf, len);
@@ -667,6 +1553,21 @@ cfclose(cfp *fp)
 		errno = EBADF;
 		return EOF;
 	}
+
+	/* Let the compression thread finish, and flush the compressor */
+	if (fp->pipeline)
+		EndPipeline(fp->pipeline);
+#if defined(USE_LZ4) || defined(USE_ZSTD)
+	if (fp->stream)
+	{
+		if (fp->pipeline)
+			EndStreamCompress(fp->stream, cfEmit, fp);
+		FreeStream(fp->stream);
+	}
+	if (fp->inbuf)
+		free(fp->inbuf);
+#endif
+
 #ifdef HAVE_LIBZ
 	if (fp->compressedfp)
 	{
@@ -687,6 +1588,8 @@ cfclose(cfp *fp)
 int
 cfeof(cfp *fp)
 {
+	if (fp->stream)
+		return fp->eof;
 #ifdef HAVE_LIBZ
 	if (fp->compressedfp)
 		return gzeof(fp->compressedfp);
@@ -695,7 +1598,45 @@ cfeof(cfp *fp)
 		return feof(fp->uncompressedfp);
 }
 
+/*
+ * Compresses and writes out a chunk of data written to a compressed stream.
+ * This is called by the compression thread, if there is one.
+ */
+static void
+cfConsume(void *arg, const char *data, size_t len)
+{
+	cfp		   *fp = (cfp *) arg;
+
+	switch (fp->alg)
+	{
+		case COMPR_ALG_NONE:
+			break;
+		case COMPR_ALG_LIBZ:
 #ifdef HAVE_LIBZ
+			if (gzwrite(fp->compressedfp, data, len) != (int) len)
+				WRITE_ERROR_EXIT;
+#endif
+			break;
+		case COMPR_ALG_LZ4:
+		case COMPR_ALG_ZSTD:
+#if defined(USE_LZ4) || defined(USE_ZSTD)
+			StreamCompress(fp->stream, data, len, cfEmit, fp);
+#endif
+			break;
+	}
+}
+
+#if defined(USE_LZ4) || defined(USE_ZSTD)
+static void
+cfEmit(void *arg, const char *data, size_t len)
+{
+	cfp		   *fp = (cfp *) arg;
+
+	if (fwrite(data, 1, len, fp->uncompressedfp) != len)
+		WRITE_ERROR_EXIT;
+}
+#endif
+
 static int
 hasSuffix(const char *filename, const char *suffix)
 {
@@ -709,5 +1650,3 @@ hasSuffix(const char *filename, const char *suffix)
 				  suffix,
 				  suffixlen) == 0;
 }
-
-#endif
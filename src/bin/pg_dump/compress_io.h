@@ -21,11 +21,16 @@
 #define ZLIB_OUT_SIZE	4096
 #define ZLIB_IN_SIZE	4096
 
-typedef enum
-{
-	COMPR_ALG_NONE,
-	COMPR_ALG_LIBZ
-} CompressionAlgorithm;
+/* Input chunk size used in LZ4 and Zstandard compression. */
+#define COMPRESS_IN_SIZE	65536
+
+/*
+ * Compressed data is handed to a separate compression thread, if we have
+ * threads, in buffers of this size.  While the thread compresses one, the
+ * caller fills the next.
+ */
+#define COMPRESS_PIPELINE_BUFSIZE	65536
+#define COMPRESS_PIPELINE_NBUFS		4
 
 /* Prototype for callback function to WriteDataToArchive() */
 typedef void (*WriteFunc) (ArchiveHandle *AH, const char *buf, size_t len);
@@ -46,8 +51,15 @@ typedef size_t (*ReadFunc) (ArchiveHandle *AH, char **buf, size_t *buflen);
 /* struct definition appears in compress_io.c */
 typedef struct CompressorState CompressorState;
 
-extern CompressorState *AllocateCompressor(int compression, WriteFunc writeF);
-extern void ReadDataFromArchive(ArchiveHandle *AH, int compression,
+extern bool ParseCompressionOption(const char *option,
+					   CompressionAlgorithm *alg, int *level);
+extern const char *CompressionAlgorithmName(CompressionAlgorithm alg);
+extern bool CompressionAlgorithmSupported(CompressionAlgorithm alg);
+extern const char *CompressionSuffix(CompressionAlgorithm alg);
+
+extern CompressorState *AllocateCompressor(ArchiveHandle *AH,
+				   CompressionAlgorithm alg, int level, WriteFunc writeF);
+extern void ReadDataFromArchive(ArchiveHandle *AH, CompressionAlgorithm alg,
 					ReadFunc readF);
 extern void WriteDataToArchive(ArchiveHandle *AH, CompressorState *cs,
 				   const void *data, size_t dLen);
@@ -56,9 +68,11 @@ extern void EndCompressor(ArchiveHandle *AH, CompressorState *cs);
 
 typedef struct cfp cfp;
 
-extern cfp *cfopen(const char *path, const char *mode, int compression);
+extern cfp *cfopen(const char *path, const char *mode,
+	   CompressionAlgorithm alg, int level);
 extern cfp *cfopen_read(const char *path, const char *mode);
-extern cfp *cfopen_write(const char *path, const char *mode, int compression);
+extern cfp *cfopen_write(const char *path, const char *mode,
+			 CompressionAlgorithm alg, int level);
 extern int	cfread(void *ptr, int size, cfp *fp);
 extern int	cfwrite(const void *ptr, int size, cfp *fp);
 extern int	cfgetc(cfp *fp);
@@ -43,6 +43,15 @@ typedef enum _archiveFormat
 	archDirectory = 5
 } ArchiveFormat;
 
+/* The values are stored in archive headers, so don't renumber them */
+typedef enum _compressionAlgorithm
+{
+	COMPR_ALG_NONE = 0,
+	COMPR_ALG_LIBZ = 1,
+	COMPR_ALG_LZ4 = 2,
+	COMPR_ALG_ZSTD = 3
+} CompressionAlgorithm;
+
 typedef enum _archiveMode
 {
 	archModeAppend,
@@ -136,12 +145,15 @@ typedef struct _restoreOptions
 	char	   *pghost;
 	char	   *username;
 	int			noDataForFailedTables;
+	int			fk_not_valid;	/* add FK constraints NOT VALID, then
+								 * validate them separately */
 	trivalue	promptPassword;
 	int			exit_on_error;
 	int			compression;
 	int			suppressDumpWarnings;	/* Suppress output of WARNING entries
 										 * to stderr */
 	bool		single_txn;
+	int			txn_size;		/* commit every this many objects, if > 0 */
 
 	bool	   *idWanted;		/* array showing which dump IDs to emit */
 	int			enable_row_security;
@@ -163,6 +175,7 @@ typedef struct _dumpOptions
 	int			dumpSections;	/* bitmask of chosen sections */
 	bool		aclsSkip;
 	const char *lockWaitTimeout;
+	int			splitTableSize; /* in MB, 0 to dump tables whole */
 
 	/* flags for various command-line long options */
 	int			disable_dollar_quoting;
@@ -260,7 +273,8 @@ extern Archive *OpenArchive(const char *FileSpec, const ArchiveFormat fmt);
 
 /* Create a new archive */
 extern Archive *CreateArchive(const char *FileSpec, const ArchiveFormat fmt,
-			  const int compression, ArchiveMode mode,
+			  CompressionAlgorithm compressionAlg, const int compression,
+			  ArchiveMode mode,
 			  SetupWorkerPtr setupDumpWorker);
 
 /* The --list option */
@@ -21,6 +21,7 @@
  */
 #include "postgres_fe.h"
 
+#include "compress_io.h"
 #include "parallel.h"
 #include "pg_backup_archiver.h"
 #include "pg_backup_db.h"
@@ -54,10 +55,13 @@ static const char *modulename = gettext_noop("archiver");
 
 
 static ArchiveHandle *_allocAH(const char *FileSpec, const ArchiveFormat fmt,
-	 const int compression, ArchiveMode mode, SetupWorkerPtr setupWorkerPtr);
+		 CompressionAlgorithm compressionAlg, const int compression,
+		 ArchiveMode mode, SetupWorkerPtr setupWorkerPtr);
 static void _getObjectDescription(PQExpBuffer buf, TocEntry *te,
 					  ArchiveHandle *AH);
 static void _printTocEntry(ArchiveHandle *AH, TocEntry *te, RestoreOptions *ropt, bool isData, bool acl_pass);
+static void _printForeignKeyNotValid(ArchiveHandle *AH, TocEntry *te);
+static bool _isReferencingTable(TocEntry *te, TocEntry *tablete);
 static char *replace_line_endings(const char *str);
 static void _doSetFixedOutputState(ArchiveHandle *AH);
 static void _doSetSessionAuth(ArchiveHandle *AH, const char *user);
@@ -86,6 +90,9 @@ static void RestoreOutput(ArchiveHandle *AH, OutputContext savedContext);
 
 static int restore_toc_entry(ArchiveHandle *AH, TocEntry *te,
 				  RestoreOptions *ropt, bool is_parallel);
+static void StartTxnBatch(ArchiveHandle *AH);
+static void CountTxnBatch(ArchiveHandle *AH);
+static void EndTxnBatch(ArchiveHandle *AH);
 static void restore_toc_entries_prefork(ArchiveHandle *AH);
 static void restore_toc_entries_parallel(ArchiveHandle *AH, ParallelState *pstate,
 							 TocEntry *pending_list);
@@ -193,10 +200,12 @@ setupRestoreWorker(Archive *AHX, DumpOptions *dopt, RestoreOptions *ropt)
 /* Public */
 Archive *
 CreateArchive(const char *FileSpec, const ArchiveFormat fmt,
-	 const int compression, ArchiveMode mode, SetupWorkerPtr setupDumpWorker)
+			  CompressionAlgorithm compressionAlg, const int compression,
+			  ArchiveMode mode, SetupWorkerPtr setupDumpWorker)
 
 {
-	ArchiveHandle *AH = _allocAH(FileSpec, fmt, compression, mode, setupDumpWorker);
+	ArchiveHandle *AH = _allocAH(FileSpec, fmt, compressionAlg, compression,
+								 mode, setupDumpWorker);
 
 	return (Archive *) AH;
 }
@@ -206,7 +215,8 @@ CreateArchive(const char *FileSpec, const ArchiveFormat fmt,
 Archive *
 OpenArchive(const char *FileSpec, const ArchiveFormat fmt)
 {
-	ArchiveHandle *AH = _allocAH(FileSpec, fmt, 0, archModeRead, setupRestoreWorker);
+	ArchiveHandle *AH = _allocAH(FileSpec, fmt, COMPR_ALG_NONE, 0, archModeRead,
+								 setupRestoreWorker);
 
 	return (Archive *) AH;
 }
@@ -306,6 +316,8 @@ RestoreArchive(Archive *AHX)
 	 */
 	if (ropt->createDB && ropt->single_txn)
 		exit_horribly(modulename, "-C and -1 are incompatible options\n");
+	if (ropt->createDB && ropt->txn_size > 0)
+		exit_horribly(modulename, "-C and --transaction-size are incompatible options\n");
 
 	/*
 	 * If we're going to do parallel restore, there are some restrictions.
@@ -331,16 +343,16 @@ RestoreArchive(Archive *AHX)
 	/*
 	 * Make sure we won't need (de)compression we haven't got
 	 */
-#ifndef HAVE_LIBZ
-	if (AH->compression != 0 && AH->PrintTocDataPtr !=NULL)
+	if (!CompressionAlgorithmSupported(AH->compressionAlg) &&
+		AH->PrintTocDataPtr !=NULL)
 	{
 		for (te = AH->toc->next; te != AH->toc; te = te->next)
 		{
 			if (te->hadDumper && (te->reqs & REQ_DATA) != 0)
-				exit_horribly(modulename, "cannot restore from compressed archive (compression not supported in this installation)\n");
+				exit_horribly(modulename, "cannot restore from compressed archive (%s compression not supported in this installation)\n",
+							  CompressionAlgorithmName(AH->compressionAlg));
 		}
 	}
-#endif
 
 	/*
 	 * Prepare index arrays, so we can assume we have them throughout restore.
@@ -433,6 +445,8 @@ RestoreArchive(Archive *AHX)
 		else
 			ahprintf(AH, "BEGIN;\n\n");
 	}
+	else if (ropt->txn_size > 0)
+		StartTxnBatch(AH);
 
 	/*
 	 * Establish important parameter values right away.
@@ -630,6 +644,8 @@ RestoreArchive(Archive *AHX)
 				ahlog(AH, 1, "setting owner and privileges for %s \"%s\"\n",
 					  te->desc, te->tag);
 			_printTocEntry(AH, te, ropt, false, true);
+			if (_tocEntryIsACL(te))
+				CountTxnBatch(AH);
 		}
 	}
 
@@ -640,6 +656,8 @@ RestoreArchive(Archive *AHX)
 		else
 			ahprintf(AH, "COMMIT;\n\n");
 	}
+	else
+		EndTxnBatch(AH);
 
 	if (AH->public.verbose)
 		dumpTimestamp(AH, "Completed on", time(NULL));
@@ -658,6 +676,53 @@ RestoreArchive(Archive *AHX)
 		DisconnectDatabase(&AH->public);
 }
 
+/*
+ * With --transaction-size, objects are restored in transactions of up to
+ * txn_size objects each.  That saves a commit, and its WAL flush, per object,
+ * which adds up for schemas with many objects, without holding locks on all
+ * of them at once as --single-transaction does.
+ */
+static void
+StartTxnBatch(ArchiveHandle *AH)
+{
+	if (AH->connection)
+		StartTransaction(&AH->public);
+	else
+		ahprintf(AH, "BEGIN;\n\n");
+	AH->inTxnBatch = true;
+	AH->txnCount = 0;
+}
+
+/*
+ * Count an object restored, and start a new transaction if the current one
+ * is full.
+ */
+static void
+CountTxnBatch(ArchiveHandle *AH)
+{
+	if (!AH->inTxnBatch)
+		return;
+
+	if (++AH->txnCount >= AH->ropt->txn_size)
+	{
+		EndTxnBatch(AH);
+		StartTxnBatch(AH);
+	}
+}
+
+static void
+EndTxnBatch(ArchiveHandle *AH)
+{
+	if (!AH->inTxnBatch)
+		return;
+
+	if (AH->connection)
+		CommitTransaction(&AH->public);
+	else
+		ahprintf(AH, "COMMIT;\n\n");
+	AH->inTxnBatch = false;
+}
+
 /*
  * Restore a single TOC item.  Used in both parallel and non-parallel restore;
  * is_parallel is true if we are in a worker child process.
@@ -809,9 +874,10 @@ restore_toc_entry(ArchiveHandle *AH, TocEntry *te,
 					 * precede it with a TRUNCATE.  If archiving is not on
 					 * this prevents WAL-logging the COPY.  This obtains a
 					 * speedup similar to that from using single_txn mode in
-					 * non-parallel restores.
+					 * non-parallel restores.  Not if the data is in chunks,
+					 * though, as the TRUNCATE would remove the other chunks.
 					 */
-					if (is_parallel && te->created)
+					if (is_parallel && te->created && !te->chunked)
 					{
 						/*
 						 * Parallel restore is always talking directly to a
@@ -870,6 +936,9 @@ restore_toc_entry(ArchiveHandle *AH, TocEntry *te,
 	if (AH->public.n_errors > 0 && status == WORKER_OK)
 		status = WORKER_IGNORED_ERRORS;
 
+	if (reqs != 0)
+		CountTxnBatch(AH);
+
 	return status;
 }
 
@@ -1053,6 +1122,8 @@ PrintTOCSummary(Archive *AHX, RestoreOptions *ropt)
 	ahprintf(AH, ";\n; Archive created at %s\n", stamp_str);
 	ahprintf(AH, ";     dbname: %s\n;     TOC Entries: %d\n;     Compression: %d\n",
 			 AH->archdbname, AH->tocCount, AH->compression);
+	ahprintf(AH, ";     Compression method: %s\n",
+			 CompressionAlgorithmName(AH->compressionAlg));
 
 	switch (AH->format)
 	{
@@ -1148,7 +1219,7 @@ EndBlob(Archive *AHX, Oid oid)
 void
 StartRestoreBlobs(ArchiveHandle *AH)
 {
-	if (!AH->ropt->single_txn)
+	if (!AH->ropt->single_txn && !AH->inTxnBatch)
 	{
 		if (AH->connection)
 			StartTransaction(&AH->public);
@@ -1165,7 +1236,7 @@ StartRestoreBlobs(ArchiveHandle *AH)
 void
 EndRestoreBlobs(ArchiveHandle *AH)
 {
-	if (!AH->ropt->single_txn)
+	if (!AH->ropt->single_txn && !AH->inTxnBatch)
 	{
 		if (AH->connection)
 			CommitTransaction(&AH->public);
@@ -1416,7 +1487,10 @@ SetOutput(ArchiveHandle *AH, const char *filename, int compression)
 		char		fmode[10];
 
 		/* Don't use PG_BINARY_x since this is zlib */
-		sprintf(fmode, "wb%d", compression);
+		if (compression == Z_DEFAULT_COMPRESSION)
+			strcpy(fmode, "wb");
+		else
+			sprintf(fmode, "wb%d", compression);
 		if (fn >= 0)
 			AH->OF = gzdopen(dup(fn), fmode);
 		else
@@ -1749,7 +1823,9 @@ buildTocEntryArrays(ArchiveHandle *AH)
 		 * tableDataId provides the TABLE DATA item's dump ID for each TABLE
 		 * TOC entry that has a DATA item.  We compute this by reversing the
 		 * TABLE DATA item's dependency, knowing that a TABLE DATA item has
-		 * just one dependency and it is the TABLE item.
+		 * just one dependency and it is the TABLE item.  A table whose data
+		 * was dumped in several chunks has several TABLE DATA items, which
+		 * we chain through nextChunk.
 		 */
 		if (strcmp(te->desc, "TABLE DATA") == 0 && te->nDeps > 0)
 		{
@@ -1763,6 +1839,12 @@ buildTocEntryArrays(ArchiveHandle *AH)
 			if (tableId <= 0 || tableId > maxDumpId)
 				exit_horribly(modulename, "bad table dumpId for TABLE DATA item\n");
 
+			if (AH->tableDataId[tableId] != 0)
+			{
+				te->chunked = true;
+				te->nextChunk = AH->tableDataId[tableId];
+				AH->tocsByDumpId[te->nextChunk]->chunked = true;
+			}
 			AH->tableDataId[tableId] = te->dumpId;
 		}
 	}
@@ -2175,7 +2257,8 @@ _discoverArchiveFormat(ArchiveHandle *AH)
  */
 static ArchiveHandle *
 _allocAH(const char *FileSpec, const ArchiveFormat fmt,
-	  const int compression, ArchiveMode mode, SetupWorkerPtr setupWorkerPtr)
+		 CompressionAlgorithm compressionAlg, const int compression,
+		 ArchiveMode mode, SetupWorkerPtr setupWorkerPtr)
 {
 	ArchiveHandle *AH;
 
@@ -2234,6 +2317,7 @@ _allocAH(const char *FileSpec, const ArchiveFormat fmt,
 
 	AH->mode = mode;
 	AH->compression = compression;
+	AH->compressionAlg = compressionAlg;
 
 	memset(&(AH->sqlparse), 0, sizeof(AH->sqlparse));
 
@@ -3272,6 +3356,10 @@ _printTocEntry(ArchiveHandle *AH, TocEntry *te, RestoreOptions *ropt, bool isDat
 	{
 		ahprintf(AH, "CREATE SCHEMA %s;\n\n\n", fmtId(te->tag));
 	}
+	else if (ropt->fk_not_valid && strcmp(te->desc, "FK CONSTRAINT") == 0)
+	{
+		_printForeignKeyNotValid(AH, te);
+	}
 	else
 	{
 		if (strlen(te->defn) > 0)
@@ -3351,6 +3439,34 @@ _printTocEntry(ArchiveHandle *AH, TocEntry *te, RestoreOptions *ropt, bool isDat
 	}
 }
 
+/*
+ * Print an FK CONSTRAINT entry as an ADD CONSTRAINT ... NOT VALID followed by
+ * a separate VALIDATE CONSTRAINT, for --fk-not-valid.  The validation then
+ * runs without the lock that ADD CONSTRAINT takes on the referenced table,
+ * so the foreign keys that reference one table can be validated at once.
+ *
+ * The definition has the form "ALTER TABLE ONLY tab\n    ADD CONSTRAINT
+ * ...;\n".  Anything else, or a constraint that is NOT VALID already, is
+ * printed as it is.
+ */
+static void
+_printForeignKeyNotValid(ArchiveHandle *AH, TocEntry *te)
+{
+	const char *nl = strchr(te->defn, '\n');
+	size_t		len = strlen(te->defn);
+
+	if (nl == NULL || len < 2 || strcmp(te->defn + len - 2, ";\n") != 0 ||
+		(len >= 12 && strncmp(te->defn + len - 12, " NOT VALID", 10) == 0))
+	{
+		ahprintf(AH, "%s\n\n", te->defn);
+		return;
+	}
+
+	ahprintf(AH, "%.*s NOT VALID;\n\n", (int) (len - 2), te->defn);
+	ahprintf(AH, "%.*s VALIDATE CONSTRAINT %s;\n\n",
+			 (int) (nl - te->defn), te->defn, fmtId(te->tag));
+}
+
 /*
  * Sanitize a string to be included in an SQL comment, by replacing any
  * newlines with spaces.
@@ -3385,15 +3501,16 @@ WriteHead(ArchiveHandle *AH)
 	(*AH->WriteBytePtr) (AH, AH->offSize);
 	(*AH->WriteBytePtr) (AH, AH->format);
 
-#ifndef HAVE_LIBZ
-	if (AH->compression != 0)
+	if (!CompressionAlgorithmSupported(AH->compressionAlg))
+	{
 		write_msg(modulename, "WARNING: requested compression not available in this "
 				  "installation -- archive will be uncompressed\n");
-
-	AH->compression = 0;
-#endif
+		AH->compression = 0;
+		AH->compressionAlg = COMPR_ALG_NONE;
+	}
 
 	WriteInt(AH, AH->compression);
+	(*AH->WriteBytePtr) (AH, AH->compressionAlg);
 
 	crtm = *localtime(&AH->createDate);
 	WriteInt(AH, crtm.tm_sec);
@@ -3472,10 +3589,17 @@ ReadHead(ArchiveHandle *AH)
 	else
 		AH->compression = Z_DEFAULT_COMPRESSION;
 
-#ifndef HAVE_LIBZ
-	if (AH->compression != 0)
-		write_msg(modulename, "WARNING: archive is compressed, but this installation does not support compression -- no data will be available\n");
-#endif
+	/* Before 1.13, any compression was gzip */
+	if (AH->version >= K_VERS_1_13)
+		AH->compressionAlg = (CompressionAlgorithm) (*AH->ReadBytePtr) (AH);
+	else if (AH->compression != 0)
+		AH->compressionAlg = COMPR_ALG_LIBZ;
+	else
+		AH->compressionAlg = COMPR_ALG_NONE;
+
+	if (!CompressionAlgorithmSupported(AH->compressionAlg))
+		write_msg(modulename, "WARNING: archive is compressed with %s, but this installation does not support it -- no data will be available\n",
+				  CompressionAlgorithmName(AH->compressionAlg));
 
 	if (AH->version >= K_VERS_1_4)
 	{
@@ -3625,8 +3749,11 @@ restore_toc_entries_prefork(ArchiveHandle *AH)
 	/*
 	 * Now close parent connection in prep for parallel steps.  We do this
 	 * mainly to ensure that we don't exceed the specified number of parallel
-	 * connections.
+	 * connections.  The workers must see what we've created, so commit first.
+	 * They don't batch their items into transactions, as holding the locks of
+	 * several items would make them block each other.
 	 */
+	EndTxnBatch(AH);
 	DisconnectDatabase(&AH->public);
 
 	/* blow away any transient state from the old connection */
@@ -3809,6 +3936,9 @@ restore_toc_entries_postfork(ArchiveHandle *AH, TocEntry *pending_list)
 					ropt->pghost, ropt->pgport, ropt->username,
 					ropt->promptPassword);
 
+	if (ropt->txn_size > 0)
+		StartTxnBatch(AH);
+
 	_doSetFixedOutputState(AH);
 
 	/*
@@ -3903,6 +4033,7 @@ get_next_work_item(ArchiveHandle *AH, TocEntry *ready_list,
 {
 	bool		pref_non_data = false;	/* or get from AH->ropt */
 	TocEntry   *data_te = NULL;
+	TocEntry   *best_te = NULL;
 	TocEntry   *te;
 	int			i,
 				k;
@@ -3923,7 +4054,9 @@ get_next_work_item(ArchiveHandle *AH, TocEntry *ready_list,
 	}
 
 	/*
-	 * Search the ready_list until we find a suitable item.
+	 * Search the ready_list for the suitable item with the most work, so
+	 * that the big items don't end up running alone at the end.  Items of
+	 * equal size are taken in TOC order.
 	 */
 	for (te = ready_list->par_next; te != ready_list; te = te->par_next)
 	{
@@ -3961,9 +4094,12 @@ get_next_work_item(ArchiveHandle *AH, TocEntry *ready_list,
 		}
 
 		/* passed all tests, so this item can run */
-		return te;
+		if (best_te == NULL || te->dataLength > best_te->dataLength)
+			best_te = te;
 	}
 
+	if (best_te != NULL)
+		return best_te;
 	if (data_te != NULL)
 		return data_te;
 
@@ -4071,6 +4207,10 @@ fix_dependencies(ArchiveHandle *AH)
 		te->par_next = NULL;
 	}
 
+	/* Let the format estimate the size of the data items */
+	if (AH->PrepParallelRestorePtr)
+		(*AH->PrepParallelRestorePtr) (AH);
+
 	/*
 	 * POST_DATA items that are shown as depending on a table need to be
 	 * re-pointed to depend on that table's data, instead.  This ensures they
@@ -4174,7 +4314,11 @@ fix_dependencies(ArchiveHandle *AH)
 
 /*
  * Change dependencies on table items to depend on table data items instead,
- * but only in POST_DATA items.
+ * but only in POST_DATA items.  If the data is in several chunks, the item
+ * is made to depend on all of them.
+ *
+ * The items also take the size of the biggest table they depend on, as the
+ * work of building an index or validating a constraint grows with it.
  */
 static void
 repoint_table_dependencies(ArchiveHandle *AH)
@@ -4182,6 +4326,7 @@ repoint_table_dependencies(ArchiveHandle *AH)
 	TocEntry   *te;
 	int			i;
 	DumpId		olddep;
+	DumpId		chunk;
 
 	for (te = AH->toc->next; te != AH->toc; te = te->next)
 	{
@@ -4193,9 +4338,27 @@ repoint_table_dependencies(ArchiveHandle *AH)
 			if (olddep <= AH->maxDumpId &&
 				AH->tableDataId[olddep] != 0)
 			{
+				pgoff_t		tablesize;
+
 				te->dependencies[i] = AH->tableDataId[olddep];
 				ahlog(AH, 2, "transferring dependency %d -> %d to %d\n",
 					  te->dumpId, olddep, AH->tableDataId[olddep]);
+
+				tablesize = AH->tocsByDumpId[te->dependencies[i]]->dataLength;
+				for (chunk = AH->tocsByDumpId[te->dependencies[i]]->nextChunk;
+					 chunk != 0;
+					 chunk = AH->tocsByDumpId[chunk]->nextChunk)
+				{
+					tablesize += AH->tocsByDumpId[chunk]->dataLength;
+					te->dependencies = (DumpId *)
+						pg_realloc(te->dependencies,
+								   (te->nDeps + 1) * sizeof(DumpId));
+					te->dependencies[te->nDeps++] = chunk;
+					te->depCount++;
+					ahlog(AH, 2, "adding dependency %d -> %d\n",
+						  te->dumpId, chunk);
+				}
+				te->dataLength = Max(te->dataLength, tablesize);
 			}
 		}
 	}
@@ -4247,6 +4410,25 @@ identify_locking_dependencies(ArchiveHandle *AH, TocEntry *te)
 			lockids[nlockids++] = depid;
 	}
 
+	/*
+	 * A foreign key added NOT VALID and validated separately holds only a
+	 * weak lock on the referenced table for most of its run, so it needs to
+	 * be kept apart only from work on the referencing table.
+	 */
+	if (AH->ropt->fk_not_valid && strcmp(te->desc, "FK CONSTRAINT") == 0)
+	{
+		int			nreferencing = 0;
+
+		for (i = 0; i < nlockids; i++)
+		{
+			if (_isReferencingTable(te, AH->tocsByDumpId[lockids[i]]))
+				lockids[nreferencing++] = lockids[i];
+		}
+		/* if we can't tell which table it is, stay on the safe side */
+		if (nreferencing > 0)
+			nlockids = nreferencing;
+	}
+
 	if (nlockids == 0)
 	{
 		free(lockids);
@@ -4257,6 +4439,25 @@ identify_locking_dependencies(ArchiveHandle *AH, TocEntry *te)
 	te->nLockDeps = nlockids;
 }
 
+/*
+ * Is tablete the TABLE or TABLE DATA item of the table an FK CONSTRAINT item
+ * is on?  That is the table named in its ALTER TABLE command.
+ */
+static bool
+_isReferencingTable(TocEntry *te, TocEntry *tablete)
+{
+	const char *name;
+	const char *prefix = "ALTER TABLE ONLY ";
+
+	if (strcmp(te->namespace, tablete->namespace) != 0 ||
+		strncmp(te->defn, prefix, strlen(prefix)) != 0)
+		return false;
+
+	name = fmtId(tablete->tag);
+	return (strncmp(te->defn + strlen(prefix), name, strlen(name)) == 0 &&
+			te->defn[strlen(prefix) + strlen(name)] == '\n');
+}
+
 /*
  * Remove the specified TOC entry from the depCounts of items that depend on
  * it, thereby possibly making them ready-to-run.  Any pending item that
@@ -4313,7 +4514,13 @@ inhibit_data_for_failed_table(ArchiveHandle *AH, TocEntry *te)
 	{
 		TocEntry   *ted = AH->tocsByDumpId[AH->tableDataId[te->dumpId]];
 
-		ted->reqs = 0;
+		for (;;)
+		{
+			ted->reqs = 0;
+			if (ted->nextChunk == 0)
+				break;
+			ted = AH->tocsByDumpId[ted->nextChunk];
+		}
 	}
 }
 
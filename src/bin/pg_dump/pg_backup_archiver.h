@@ -64,7 +64,7 @@ typedef z_stream *z_streamp;
 
 /* Current archive version number (the format we can output) */
 #define K_VERS_MAJOR 1
-#define K_VERS_MINOR 12
+#define K_VERS_MINOR 13
 #define K_VERS_REV 0
 
 /* Data block types */
@@ -90,9 +90,11 @@ typedef z_stream *z_streamp;
 																 * indicator */
 #define K_VERS_1_12 (( (1 * 256 + 12) * 256 + 0) * 256 + 0)		/* add separate BLOB
 																 * entries */
+#define K_VERS_1_13 (( (1 * 256 + 13) * 256 + 0) * 256 + 0)		/* add compression
+																 * algorithm */
 
 /* Newest format we can read */
-#define K_VERS_MAX (( (1 * 256 + 12) * 256 + 255) * 256 + 0)
+#define K_VERS_MAX (( (1 * 256 + 13) * 256 + 255) * 256 + 0)
 
 
 /* Flags to indicate disposition of offsets stored in files */
@@ -162,6 +164,8 @@ typedef void (*PrintTocDataPtr) (ArchiveHandle *AH, TocEntry *te, RestoreOptions
 typedef void (*ClonePtr) (ArchiveHandle *AH);
 typedef void (*DeClonePtr) (ArchiveHandle *AH);
 
+typedef void (*PrepParallelRestorePtr) (ArchiveHandle *AH);
+
 typedef char *(*WorkerJobRestorePtr) (ArchiveHandle *AH, TocEntry *te);
 typedef char *(*WorkerJobDumpPtr) (ArchiveHandle *AH, DumpOptions *dopt, TocEntry *te);
 typedef char *(*MasterStartParallelItemPtr) (ArchiveHandle *AH, TocEntry *te,
@@ -277,6 +281,9 @@ struct _archiveHandle
 	ClonePtr ClonePtr;			/* Clone format-specific fields */
 	DeClonePtr DeClonePtr;		/* Clean up cloned fields */
 
+	PrepParallelRestorePtr PrepParallelRestorePtr;	/* Set the dataLength of
+													 * TOC entries */
+
 	CustomOutPtr CustomOutPtr;	/* Alternative script output routine */
 
 	/* Stuff for direct DB connection */
@@ -294,6 +301,9 @@ struct _archiveHandle
 	int			writingBlob;	/* Flag */
 	int			blobCount;		/* # of blobs restored */
 
+	bool		inTxnBatch;		/* in a --transaction-size transaction? */
+	int			txnCount;		/* # of objects restored in it so far */
+
 	char	   *fSpec;			/* Archive File Spec */
 	FILE	   *FH;				/* General purpose file handle */
 	void	   *OF;
@@ -305,13 +315,17 @@ struct _archiveHandle
 
 	/* arrays created after the TOC list is complete: */
 	struct _tocEntry **tocsByDumpId;	/* TOCs indexed by dumpId */
-	DumpId	   *tableDataId;	/* TABLE DATA ids, indexed by table dumpId */
+	DumpId	   *tableDataId;	/* TABLE DATA ids, indexed by table dumpId;
+								 * the first of the nextChunk chain if the
+								 * data is in several chunks */
 
 	struct _tocEntry *currToc;	/* Used when dumping data */
 	int			compression;	/* Compression requested on open Possible
 								 * values for compression: -1
 								 * Z_DEFAULT_COMPRESSION 0	COMPRESSION_NONE
-								 * 1-9 levels for gzip compression */
+								 * 1-9 levels for gzip compression, or the
+								 * level for compressionAlg */
+	CompressionAlgorithm compressionAlg;	/* gzip, lz4 or zstd, or none */
 	ArchiveMode mode;			/* File mode - r or w */
 	void	   *formatData;		/* Header data specific to file format */
 
@@ -364,6 +378,9 @@ struct _tocEntry
 	/* working state while dumping/restoring */
 	teReqs		reqs;			/* do we need schema and/or data of object */
 	bool		created;		/* set for DATA member if TABLE was created */
+	bool		chunked;		/* DATA member that is one of several chunks */
+	DumpId		nextChunk;		/* next chunk of the same table, or 0 */
+	pgoff_t		dataLength;		/* estimated work, for parallel restore */
 
 	/* working state (needed only for parallel restore) */
 	struct _tocEntry *par_prev; /* list links for pending/ready items; */
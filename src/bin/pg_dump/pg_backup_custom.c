@@ -29,6 +29,8 @@
 #include "parallel.h"
 #include "pg_backup_utils.h"
 
+#include <sys/stat.h>
+
 /*--------
  * Routines in the format interface
  *--------
@@ -60,6 +62,7 @@ static void _EndBlobs(ArchiveHandle *AH, TocEntry *te);
 static void _LoadBlobs(ArchiveHandle *AH, bool drop);
 static void _Clone(ArchiveHandle *AH);
 static void _DeClone(ArchiveHandle *AH);
+static void _PrepParallelRestore(ArchiveHandle *AH);
 
 static char *_MasterStartParallelItem(ArchiveHandle *AH, TocEntry *te, T_Action act);
 static int	_MasterEndParallelItem(ArchiveHandle *AH, TocEntry *te, const char *str, T_Action act);
@@ -132,6 +135,7 @@ InitArchiveFmt_Custom(ArchiveHandle *AH)
 	AH->EndBlobsPtr = _EndBlobs;
 	AH->ClonePtr = _Clone;
 	AH->DeClonePtr = _DeClone;
+	AH->PrepParallelRestorePtr = _PrepParallelRestore;
 
 	AH->MasterStartParallelItemPtr = _MasterStartParallelItem;
 	AH->MasterEndParallelItemPtr = _MasterEndParallelItem;
@@ -304,7 +308,8 @@ _StartData(ArchiveHandle *AH, TocEntry *te)
 	_WriteByte(AH, BLK_DATA);	/* Block type */
 	WriteInt(AH, te->dumpId);	/* For sanity check */
 
-	ctx->cs = AllocateCompressor(AH->compression, _CustomWriteFunc);
+	ctx->cs = AllocateCompressor(AH, AH->compressionAlg, AH->compression,
+								 _CustomWriteFunc);
 }
 
 /*
@@ -385,7 +390,8 @@ _StartBlob(ArchiveHandle *AH, TocEntry *te, Oid oid)
 
 	WriteInt(AH, oid);
 
-	ctx->cs = AllocateCompressor(AH->compression, _CustomWriteFunc);
+	ctx->cs = AllocateCompressor(AH, AH->compressionAlg, AH->compression,
+								 _CustomWriteFunc);
 }
 
 /*
@@ -516,7 +522,7 @@ _PrintTocData(ArchiveHandle *AH, TocEntry *te, RestoreOptions *ropt)
 static void
 _PrintData(ArchiveHandle *AH)
 {
-	ReadDataFromArchive(AH, AH->compression, _CustomReadFunc);
+	ReadDataFromArchive(AH, AH->compressionAlg, _CustomReadFunc);
 }
 
 static void
@@ -807,6 +813,57 @@ _DeClone(ArchiveHandle *AH)
 	free(ctx);
 }
 
+static int
+_dataPosCompare(const void *a, const void *b)
+{
+	pgoff_t		apos = ((lclTocEntry *) (*(TocEntry *const *) a)->formatData)->dataPos;
+	pgoff_t		bpos = ((lclTocEntry *) (*(TocEntry *const *) b)->formatData)->dataPos;
+
+	if (apos < bpos)
+		return -1;
+	if (apos > bpos)
+		return 1;
+	return 0;
+}
+
+/*
+ * Set the dataLength of the TOC entries that have data, for scheduling a
+ * parallel restore.  An entry's data extends to where the next one's starts,
+ * or to the end of the file.
+ */
+static void
+_PrepParallelRestore(ArchiveHandle *AH)
+{
+	TocEntry   *te;
+	TocEntry  **tes;
+	int			ntes = 0;
+	int			i;
+	struct stat st;
+
+	tes = (TocEntry **) pg_malloc((AH->maxDumpId + 1) * sizeof(TocEntry *));
+	for (te = AH->toc->next; te != AH->toc; te = te->next)
+	{
+		lclTocEntry *tctx = (lclTocEntry *) te->formatData;
+
+		if (tctx != NULL && tctx->dataState == K_OFFSET_POS_SET)
+			tes[ntes++] = te;
+	}
+	qsort(tes, ntes, sizeof(TocEntry *), _dataPosCompare);
+
+	for (i = 0; i < ntes; i++)
+	{
+		pgoff_t		start = ((lclTocEntry *) tes[i]->formatData)->dataPos;
+
+		if (i + 1 < ntes)
+			tes[i]->dataLength =
+				((lclTocEntry *) tes[i + 1]->formatData)->dataPos - start;
+		else if (fstat(fileno(AH->FH), &st) == 0 && st.st_size > start)
+			tes[i]->dataLength = st.st_size - start;
+	}
+
+	free(tes);
+}
+
 /*
  * This function is executed in the child of a parallel backup for the
  * custom format archive and dumps the actual data.
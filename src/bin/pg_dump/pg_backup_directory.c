@@ -7,9 +7,10 @@
  *	Large objects (BLOBs) are stored in separate files named "blob_<uid>.dat",
  *	and there's a plain-text TOC file for them called "blobs.toc". If
  *	compression is used, each data file is individually compressed and the
- *	".gz" suffix is added to the filenames. The TOC files are never
- *	compressed by pg_dump, however they are accepted with the .gz suffix too,
- *	in case the user has manually compressed them with 'gzip'.
+ *	".gz", ".lz4" or ".zst" suffix is added to the filenames. The TOC files
+ *	are never compressed by pg_dump, however they are accepted with those
+ *	suffixes too, in case the user has manually compressed them with 'gzip',
+ *	'lz4' or 'zstd'.
  *
  *	NOTE: This format is identical to the files written in the tar file in
  *	the 'tar' format, except that we don't write the restore.sql file (TODO),
@@ -88,6 +89,7 @@ static void _LoadBlobs(ArchiveHandle *AH, RestoreOptions *ropt);
 
 static void _Clone(ArchiveHandle *AH);
 static void _DeClone(ArchiveHandle *AH);
+static void _PrepParallelRestore(ArchiveHandle *AH);
 
 static char *_MasterStartParallelItem(ArchiveHandle *AH, TocEntry *te, T_Action act);
 static int _MasterEndParallelItem(ArchiveHandle *AH, TocEntry *te,
@@ -136,6 +138,7 @@ InitArchiveFmt_Directory(ArchiveHandle *AH)
 
 	AH->ClonePtr = _Clone;
 	AH->DeClonePtr = _DeClone;
+	AH->PrepParallelRestorePtr = _PrepParallelRestore;
 
 	AH->WorkerJobRestorePtr = _WorkerJobRestoreDirectory;
 	AH->WorkerJobDumpPtr = _WorkerJobDumpDirectory;
@@ -336,7 +339,8 @@ _StartData(ArchiveHandle *AH, TocEntry *te)
 
 	setFilePath(AH, fname, tctx->filename);
 
-	ctx->dataFH = cfopen_write(fname, PG_BINARY_W, AH->compression);
+	ctx->dataFH = cfopen_write(fname, PG_BINARY_W, AH->compressionAlg,
+							   AH->compression);
 	if (ctx->dataFH == NULL)
 		exit_horribly(modulename, "could not open output file \"%s\": %s\n",
 					  fname, strerror(errno));
@@ -582,7 +586,7 @@ _CloseArchive(ArchiveHandle *AH, DumpOptions *dopt)
 		ctx->pstate = ParallelBackupStart(AH, dopt, NULL);
 
 		/* The TOC is always created uncompressed */
-		tocFH = cfopen_write(fname, PG_BINARY_W, 0);
+		tocFH = cfopen_write(fname, PG_BINARY_W, COMPR_ALG_NONE, 0);
 		if (tocFH == NULL)
 			exit_horribly(modulename, "could not open output file \"%s\": %s\n",
 						  fname, strerror(errno));
@@ -640,7 +644,7 @@ _StartBlobs(ArchiveHandle *AH, TocEntry *te)
 	setFilePath(AH, fname, "blobs.toc");
 
 	/* The blob TOC file is never compressed */
-	ctx->blobsTocFH = cfopen_write(fname, "ab", 0);
+	ctx->blobsTocFH = cfopen_write(fname, "ab", COMPR_ALG_NONE, 0);
 	if (ctx->blobsTocFH == NULL)
 		exit_horribly(modulename, "could not open output file \"%s\": %s\n",
 					  fname, strerror(errno));
@@ -659,7 +663,8 @@ _StartBlob(ArchiveHandle *AH, TocEntry *te, Oid oid)
 
 	snprintf(fname, MAXPGPATH, "%s/blob_%u.dat", ctx->directory, oid);
 
-	ctx->dataFH = cfopen_write(fname, PG_BINARY_W, AH->compression);
+	ctx->dataFH = cfopen_write(fname, PG_BINARY_W, AH->compressionAlg,
+							   AH->compression);
 
 	if (ctx->dataFH == NULL)
 		exit_horribly(modulename, "could not open output file \"%s\": %s\n",
@@ -757,6 +762,38 @@ _DeClone(ArchiveHandle *AH)
 	free(ctx);
 }
 
+/*
+ * Set the dataLength of the TOC entries that have data to the size of their
+ * data files, for scheduling a parallel restore.  Compressed files count at
+ * their compressed size, which is good enough to compare them.
+ */
+static void
+_PrepParallelRestore(ArchiveHandle *AH)
+{
+	TocEntry   *te;
+
+	for (te = AH->toc->next; te != AH->toc; te = te->next)
+	{
+		lclTocEntry *tctx = (lclTocEntry *) te->formatData;
+		char		fname[MAXPGPATH];
+		struct stat st;
+
+		if (tctx == NULL || tctx->filename == NULL)
+			continue;
+
+		setFilePath(AH, fname, tctx->filename);
+		if (stat(fname, &st) == 0)
+			te->dataLength = st.st_size;
+		else if (AH->compressionAlg != COMPR_ALG_NONE &&
+				 strlen(fname) + strlen(CompressionSuffix(AH->compressionAlg)) < MAXPGPATH)
+		{
+			strcat(fname, CompressionSuffix(AH->compressionAlg));
+			if (stat(fname, &st) == 0)
+				te->dataLength = st.st_size;
+		}
+	}
+}
+
 /*
  * This function is executed in the parent process. Depending on the desired
  * action (dump or restore) it creates a string that is understood by the
@@ -213,7 +213,10 @@ InitArchiveFmt_Tar(ArchiveHandle *AH)
 
 		/* Don't compress into tar files unless asked to do so */
 		if (AH->compression == Z_DEFAULT_COMPRESSION)
+		{
 			AH->compression = 0;
+			AH->compressionAlg = COMPR_ALG_NONE;
+		}
 
 		/*
 		 * We don't support compression because reading the files back is not
@@ -55,6 +55,7 @@
 #include "catalog/pg_type.h"
 #include "libpq/libpq-fs.h"
 
+#include "compress_io.h"
 #include "dumputils.h"
 #include "parallel.h"
 #include "pg_backup_db.h"
@@ -211,6 +212,9 @@ static void addBoundaryDependencies(DumpableObject **dobjs, int numObjs,
 static void getDomainConstraints(Archive *fout, TypeInfo *tyinfo);
 static void getTableData(DumpOptions *dopt, TableInfo *tblinfo, int numTables, bool oids);
 static void makeTableDataInfo(DumpOptions *dopt, TableInfo *tbinfo, bool oids);
+static void splitTableData(Archive *fout, DumpOptions *dopt);
+static void splitTableDataOnKey(Archive *fout, DumpOptions *dopt,
+					IndxInfo *indxinfo);
 static void buildMatViewRefreshDependencies(Archive *fout);
 static void getTableDataFKConstraints(void);
 static char *format_function_arguments(FuncInfo *finfo, char *funcargs,
@@ -275,7 +279,9 @@ main(int argc, char **argv)
 	char	   *use_role = NULL;
 	int			numWorkers = 1;
 	trivalue	prompt_password = TRI_DEFAULT;
-	int			compressLevel = -1;
+	CompressionAlgorithm compressAlg = COMPR_ALG_NONE;
+	int			compressLevel = 0;
+	bool		compressGiven = false;
 	int			plainText = 0;
 	ArchiveFormat archiveFormat = archUnknown;
 	ArchiveMode archiveMode;
@@ -332,6 +338,7 @@ main(int argc, char **argv)
 		{"section", required_argument, NULL, 5},
 		{"serializable-deferrable", no_argument, &dopt.serializable_deferrable, 1},
 		{"snapshot", required_argument, NULL, 6},
+		{"split-table-size", required_argument, NULL, 7},
 		{"use-set-session-authorization", no_argument, &dopt.use_setsessauth, 1},
 		{"no-security-labels", no_argument, &dopt.no_security_labels, 1},
 		{"no-synchronized-snapshots", no_argument, &dopt.no_synchronized_snapshots, 1},
@@ -483,8 +490,12 @@ main(int argc, char **argv)
 				dopt.aclsSkip = true;
 				break;
 
-			case 'Z':			/* Compression Level */
-				compressLevel = atoi(optarg);
+			case 'Z':			/* Compression method and level */
+				if (!ParseCompressionOption(optarg, &compressAlg,
+											&compressLevel))
+					exit_horribly(NULL, "invalid compression specification \"%s\"\n",
+								  optarg);
+				compressGiven = true;
 				break;
 
 			case 0:
@@ -511,6 +522,15 @@ main(int argc, char **argv)
 				dumpsnapshot = pg_strdup(optarg);
 				break;
 
+			case 7:				/* split-table-size */
+				dopt.splitTableSize = atoi(optarg);
+				if (dopt.splitTableSize <= 0)
+				{
+					write_msg(NULL, "invalid table split size \"%s\"\n", optarg);
+					exit_nicely(1);
+				}
+				break;
+
 			default:
 				fprintf(stderr, _("Try \"%s --help\" for more information.\n"), progname);
 				exit_nicely(1);
@@ -568,12 +588,22 @@ main(int argc, char **argv)
 		plainText = 1;
 
 	/* Custom and directory formats are compressed by default, others not */
-	if (compressLevel == -1)
+	if (!compressGiven)
 	{
 		if (archiveFormat == archCustom || archiveFormat == archDirectory)
+		{
+			compressAlg = COMPR_ALG_LIBZ;
 			compressLevel = Z_DEFAULT_COMPRESSION;
-		else
-			compressLevel = 0;
+		}
+	}
+	else if (compressAlg == COMPR_ALG_LZ4 || compressAlg == COMPR_ALG_ZSTD)
+	{
+		if (archiveFormat != archCustom && archiveFormat != archDirectory)
+			exit_horribly(NULL, "compression method \"%s\" is only supported by the custom and directory formats\n",
+						  CompressionAlgorithmName(compressAlg));
+		if (!CompressionAlgorithmSupported(compressAlg))
+			exit_horribly(NULL, "compression method \"%s\" is not supported by this installation\n",
+						  CompressionAlgorithmName(compressAlg));
 	}
 
 	/*
@@ -593,8 +623,8 @@ main(int argc, char **argv)
 		exit_horribly(NULL, "parallel backup only supported by the directory format\n");
 
 	/* Open the output file */
-	fout = CreateArchive(filename, archiveFormat, compressLevel, archiveMode,
-						 setupDumpWorker);
+	fout = CreateArchive(filename, archiveFormat, compressAlg, compressLevel,
+						 archiveMode, setupDumpWorker);
 
 	/* Register the cleanup hook */
 	on_exit_close_archive(fout);
@@ -727,6 +757,8 @@ main(int argc, char **argv)
 	if (!dopt.schemaOnly)
 	{
 		getTableData(&dopt, tblinfo, numTables, dopt.oids);
+		if (dopt.splitTableSize > 0)
+			splitTableData(fout, &dopt);
 		buildMatViewRefreshDependencies(fout);
 		if (dopt.dataOnly)
 			getTableDataFKConstraints();
@@ -816,7 +848,7 @@ main(int argc, char **argv)
 	ropt->include_everything = dopt.include_everything;
 	ropt->enable_row_security = dopt.enable_row_security;
 
-	if (compressLevel == -1)
+	if (compressAlg == COMPR_ALG_NONE)
 		ropt->compression = 0;
 	else
 		ropt->compression = compressLevel;
@@ -863,7 +895,9 @@ help(const char *progname)
 	printf(_("  -j, --jobs=NUM               use this many parallel jobs to dump\n"));
 	printf(_("  -v, --verbose                verbose mode\n"));
 	printf(_("  -V, --version                output version information, then exit\n"));
-	printf(_("  -Z, --compress=0-9           compression level for compressed formats\n"));
+	printf(_("  -Z, --compress=METHOD[:LEVEL]\n"
+			 "                               compression method (none, gzip, lz4, zstd)\n"
+			 "                               and level, or gzip level 0-9\n"));
 	printf(_("  --lock-wait-timeout=TIMEOUT  fail after waiting TIMEOUT for a table lock\n"));
 	printf(_("  -?, --help                   show this help, then exit\n"));
 
@@ -899,6 +933,7 @@ help(const char *progname)
 	printf(_("  --section=SECTION            dump named section (pre-data, data, or post-data)\n"));
 	printf(_("  --serializable-deferrable    wait until the dump can run without anomalies\n"));
 	printf(_("  --snapshot=SNAPSHOT          use given synchronous snapshot for the dump\n"));
+	printf(_("  --split-table-size=MB        dump the data of larger tables in chunks of MB\n"));
 	printf(_("  --use-set-session-authorization\n"
 			 "                               use SET SESSION AUTHORIZATION commands instead of\n"
 			 "                               ALTER OWNER commands to set ownership\n"));
@@ -1476,7 +1511,7 @@ dumpTableData_copy(Archive *fout, DumpOptions *dopt, void *dcontext)
 		}
 		else
 			appendPQExpBufferStr(q, "* ");
-		appendPQExpBuffer(q, "FROM %s %s) TO stdout;",
+		appendPQExpBuffer(q, "FROM ONLY %s %s) TO stdout;",
 						  fmtQualifiedId(fout->remoteVersion,
 										 tbinfo->dobj.namespace->dobj.name,
 										 classname),
@@ -1932,11 +1967,177 @@ makeTableDataInfo(DumpOptions *dopt, TableInfo *tbinfo, bool oids)
 	tdinfo->tdtable = tbinfo;
 	tdinfo->oids = oids;
 	tdinfo->filtercond = NULL;	/* might get set later */
+	tdinfo->relpages = tbinfo->relpages;
+	tdinfo->nextChunk = NULL;
 	addObjectDependency(&tdinfo->dobj, tbinfo->dobj.dumpId);
 
 	tbinfo->dataObj = tdinfo;
 }
 
+/*
+ * splitTableData -
+ *	  divide the data of tables larger than --split-table-size into chunks
+ *
+ * Each chunk is a separate TABLE DATA object, dumped with a WHERE condition
+ * on a range of the table's primary key, so that a parallel dump or restore
+ * can work on several parts of one large table at once.  Only tables with a
+ * single-column primary key can be split.
+ */
+static void
+splitTableData(Archive *fout, DumpOptions *dopt)
+{
+	DumpableObject **dobjs;
+	int			numObjs;
+	int			i;
+
+	/* we need pg_stats.inherited */
+	if (fout->remoteVersion < 90000)
+		return;
+
+	getDumpableObjects(&dobjs, &numObjs);
+	for (i = 0; i < numObjs; i++)
+	{
+		IndxInfo   *indxinfo;
+		ConstraintInfo *coninfo;
+
+		if (dobjs[i]->objType != DO_INDEX)
+			continue;
+		indxinfo = (IndxInfo *) dobjs[i];
+		if (indxinfo->indexconstraint == 0 || indxinfo->indnkeys != 1 ||
+			indxinfo->indkeys[0] <= 0)
+			continue;
+		coninfo = (ConstraintInfo *) findObjectByDumpId(indxinfo->indexconstraint);
+		if (coninfo == NULL || coninfo->contype != 'p')
+			continue;
+
+		splitTableDataOnKey(fout, dopt, indxinfo);
+	}
+	free(dobjs);
+}
+
+/*
+ * splitTableDataOnKey -
+ *	  split the data of the index's table on the index column, if large
+ *
+ * The split points are taken from the column's histogram in pg_stats, so
+ * the chunks hold similar numbers of rows.  Tables that were never analyzed
+ * are dumped whole.
+ */
+static void
+splitTableDataOnKey(Archive *fout, DumpOptions *dopt, IndxInfo *indxinfo)
+{
+	TableInfo  *tbinfo = indxinfo->indextable;
+	TableDataInfo *tdinfo = tbinfo->dataObj;
+	int			attnum = indxinfo->indkeys[0];
+	PQExpBuffer query;
+	PQExpBuffer cond;
+	PGresult   *res;
+	char	   *keyname;
+	char	   *prevcond = NULL;
+	int64		chunkpages;
+	int			nchunks;
+	int			nbounds;
+	int			i;
+
+	/* Config tables already have a filter, and WITH OIDS can't have one */
+	if (tdinfo == NULL || tdinfo->dobj.objType != DO_TABLE_DATA ||
+		tdinfo->filtercond != NULL || (tdinfo->oids && tbinfo->hasoids))
+		return;
+	if (attnum > tbinfo->numatts)
+		return;
+
+	chunkpages = (int64) dopt->splitTableSize * 1024 * 1024 / BLCKSZ;
+	if (tbinfo->relpages / chunkpages < 2)
+		return;
+	nchunks = tbinfo->relpages / chunkpages;
+
+	selectSourceSchema(fout, tbinfo->dobj.namespace->dobj.name);
+
+	query = createPQExpBuffer();
+	appendPQExpBuffer(query,
+					  "SELECT b FROM pg_catalog.unnest("
+					  "(SELECT histogram_bounds::pg_catalog.text::%s[] "
+					  "FROM pg_catalog.pg_stats "
+					  "WHERE NOT inherited AND schemaname = ",
+					  tbinfo->atttypnames[attnum - 1]);
+	appendStringLiteralAH(query, tbinfo->dobj.namespace->dobj.name, fout);
+	appendPQExpBufferStr(query, " AND tablename = ");
+	appendStringLiteralAH(query, tbinfo->dobj.name, fout);
+	appendPQExpBufferStr(query, " AND attname = ");
+	appendStringLiteralAH(query, tbinfo->attnames[attnum - 1], fout);
+	appendPQExpBufferStr(query, ")) b");
+
+	res = ExecuteSqlQuery(fout, query->data, PGRES_TUPLES_OK);
+	nbounds = PQntuples(res);
+
+	/* the histogram divides the rows into nbounds - 1 equal parts */
+	if (nchunks > nbounds - 1)
+		nchunks = nbounds - 1;
+	if (nchunks < 2)
+	{
+		PQclear(res);
+		destroyPQExpBuffer(query);
+		return;
+	}
+
+	if (g_verbose)
+		write_msg(NULL, "splitting data of table \"%s\" into %d chunks\n",
+				  tbinfo->dobj.name, nchunks);
+
+	keyname = pg_strdup(fmtId(tbinfo->attnames[attnum - 1]));
+	cond = createPQExpBuffer();
+
+	for (i = 0; i < nchunks; i++)
+	{
+		TableDataInfo *chunk;
+
+		resetPQExpBuffer(cond);
+		appendPQExpBufferStr(cond, "WHERE ");
+		if (prevcond)
+			appendPQExpBuffer(cond, "%s >= %s", keyname, prevcond);
+		if (prevcond && i < nchunks - 1)
+			appendPQExpBufferStr(cond, " AND ");
+		if (i < nchunks - 1)
+		{
+			int			b = (i + 1) * (nbounds - 1) / nchunks;
+
+			resetPQExpBuffer(query);
+			appendStringLiteralAH(query, PQgetvalue(res, b, 0), fout);
+			appendPQExpBuffer(query, "::%s", tbinfo->atttypnames[attnum - 1]);
+			if (prevcond)
+				free(prevcond);
+			prevcond = pg_strdup(query->data);
+			appendPQExpBuffer(cond, "%s < %s", keyname, prevcond);
+		}
+
+		if (i == 0)
+			chunk = tdinfo;
+		else
+		{
+			chunk = (TableDataInfo *) pg_malloc(sizeof(TableDataInfo));
+			*chunk = *tdinfo;
+			chunk->dobj.dependencies = NULL;
+			chunk->dobj.nDeps = 0;
+			chunk->dobj.allocDeps = 0;
+			AssignDumpId(&chunk->dobj);
+			addObjectDependency(&chunk->dobj, tbinfo->dobj.dumpId);
+
+			/* link it behind the previous chunk */
+			chunk->nextChunk = tdinfo->nextChunk;
+			tdinfo->nextChunk = chunk;
+		}
+		chunk->filtercond = pg_strdup(cond->data);
+		chunk->relpages = tbinfo->relpages / nchunks;
+	}
+
+	free(keyname);
+	if (prevcond)
+		free(prevcond);
+	PQclear(res);
+	destroyPQExpBuffer(query);
+	destroyPQExpBuffer(cond);
+}
+
 /*
  * The refresh for a materialized view must be dependent on the refresh for
  * any materialized view that this one is dependent on.
@@ -2075,6 +2276,7 @@ getTableDataFKConstraints(void)
 		{
 			ConstraintInfo *cinfo = (ConstraintInfo *) dobjs[i];
 			TableInfo  *ftable;
+			TableDataInfo *tdinfo;
 
 			/* Not interesting unless both tables are to be dumped */
 			if (cinfo->contable == NULL ||
@@ -2086,11 +2288,20 @@ getTableDataFKConstraints(void)
 				continue;
 
 			/*
-			 * Okay, make referencing table's TABLE_DATA object depend on the
-			 * referenced table's TABLE_DATA object.
+			 * Okay, make referencing table's TABLE_DATA objects depend on the
+			 * referenced table's TABLE_DATA objects.  There are several of
+			 * each if the data was split into chunks.
 			 */
-			addObjectDependency(&cinfo->contable->dataObj->dobj,
-								ftable->dataObj->dobj.dumpId);
+			for (tdinfo = cinfo->contable->dataObj; tdinfo;
+				 tdinfo = tdinfo->nextChunk)
+			{
+				TableDataInfo *ftdinfo;
+
+				for (ftdinfo = ftable->dataObj; ftdinfo;
+					 ftdinfo = ftdinfo->nextChunk)
+					addObjectDependency(&tdinfo->dobj,
+										ftdinfo->dobj.dumpId);
+			}
 		}
 	}
 	free(dobjs);
@@ -12125,6 +12336,7 @@ dumpAgg(Archive *fout, DumpOptions *dopt, AggInfo *agginfo)
 	PGresult   *res;
 	int			i_aggtransfn;
 	int			i_aggfinalfn;
+	int			i_aggcombinefn;
 	int			i_aggmtransfn;
 	int			i_aggminvtransfn;
 	int			i_aggmfinalfn;
@@ -12141,6 +12353,7 @@ dumpAgg(Archive *fout, DumpOptions *dopt, AggInfo *agginfo)
 	int			i_convertok;
 	const char *aggtransfn;
 	const char *aggfinalfn;
+	const char *aggcombinefn;
 	const char *aggmtransfn;
 	const char *aggminvtransfn;
 	const char *aggmfinalfn;
@@ -12171,10 +12384,31 @@ dumpAgg(Archive *fout, DumpOptions *dopt, AggInfo *agginfo)
 	selectSourceSchema(fout, agginfo->aggfn.dobj.namespace->dobj.name);
 
 	/* Get aggregate-specific details */
-	if (fout->remoteVersion >= 90400)
+	if (fout->remoteVersion >= 90500)
+	{
+		appendPQExpBuffer(query, "SELECT aggtransfn, "
+						  "aggfinalfn, aggtranstype::pg_catalog.regtype, "
+						  "aggcombinefn, "
+						  "aggmtransfn, aggminvtransfn, aggmfinalfn, "
+						  "aggmtranstype::pg_catalog.regtype, "
+						  "aggfinalextra, aggmfinalextra, "
+						  "aggsortop::pg_catalog.regoperator, "
+						  "(aggkind = 'h') AS hypothetical, "
+						  "aggtransspace, agginitval, "
+						  "aggmtransspace, aggminitval, "
+						  "true AS convertok, "
+				  "pg_catalog.pg_get_function_arguments(p.oid) AS funcargs, "
+		 "pg_catalog.pg_get_function_identity_arguments(p.oid) AS funciargs "
+					  "FROM pg_catalog.pg_aggregate a, pg_catalog.pg_proc p "
+						  "WHERE a.aggfnoid = p.oid "
+						  "AND p.oid = '%u'::pg_catalog.oid",
+						  agginfo->aggfn.dobj.catId.oid);
+	}
+	else if (fout->remoteVersion >= 90400)
 	{
 		appendPQExpBuffer(query, "SELECT aggtransfn, "
 						  "aggfinalfn, aggtranstype::pg_catalog.regtype, "
+						  "'-' AS aggcombinefn, "
 						  "aggmtransfn, aggminvtransfn, aggmfinalfn, "
 						  "aggmtranstype::pg_catalog.regtype, "
 						  "aggfinalextra, aggmfinalextra, "
@@ -12194,6 +12428,7 @@ dumpAgg(Archive *fout, DumpOptions *dopt, AggInfo *agginfo)
 	{
 		appendPQExpBuffer(query, "SELECT aggtransfn, "
 						  "aggfinalfn, aggtranstype::pg_catalog.regtype, "
+						  "'-' AS aggcombinefn, "
 						  "'-' AS aggmtransfn, '-' AS aggminvtransfn, "
 						  "'-' AS aggmfinalfn, 0 AS aggmtranstype, "
 						  "false AS aggfinalextra, false AS aggmfinalextra, "
@@ -12213,6 +12448,7 @@ dumpAgg(Archive *fout, DumpOptions *dopt, AggInfo *agginfo)
 	{
 		appendPQExpBuffer(query, "SELECT aggtransfn, "
 						  "aggfinalfn, aggtranstype::pg_catalog.regtype, "
+						  "'-' AS aggcombinefn, "
 						  "'-' AS aggmtransfn, '-' AS aggminvtransfn, "
 						  "'-' AS aggmfinalfn, 0 AS aggmtranstype, "
 						  "false AS aggfinalextra, false AS aggmfinalextra, "
@@ -12230,6 +12466,7 @@ dumpAgg(Archive *fout, DumpOptions *dopt, AggInfo *agginfo)
 	{
 		appendPQExpBuffer(query, "SELECT aggtransfn, "
 						  "aggfinalfn, aggtranstype::pg_catalog.regtype, "
+						  "'-' AS aggcombinefn, "
 						  "'-' AS aggmtransfn, '-' AS aggminvtransfn, "
 						  "'-' AS aggmfinalfn, 0 AS aggmtranstype, "
 						  "false AS aggfinalextra, false AS aggmfinalextra, "
@@ -12247,6 +12484,7 @@ dumpAgg(Archive *fout, DumpOptions *dopt, AggInfo *agginfo)
 	{
 		appendPQExpBuffer(query, "SELECT aggtransfn, aggfinalfn, "
 						  "format_type(aggtranstype, NULL) AS aggtranstype, "
+						  "'-' AS aggcombinefn, "
 						  "'-' AS aggmtransfn, '-' AS aggminvtransfn, "
 						  "'-' AS aggmfinalfn, 0 AS aggmtranstype, "
 						  "false AS aggfinalextra, false AS aggmfinalextra, "
@@ -12264,6 +12502,7 @@ dumpAgg(Archive *fout, DumpOptions *dopt, AggInfo *agginfo)
 		appendPQExpBuffer(query, "SELECT aggtransfn1 AS aggtransfn, "
 						  "aggfinalfn, "
 						  "(SELECT typname FROM pg_type WHERE oid = aggtranstype1) AS aggtranstype, "
+						  "'-' AS aggcombinefn, "
 						  "'-' AS aggmtransfn, '-' AS aggminvtransfn, "
 						  "'-' AS aggmfinalfn, 0 AS aggmtranstype, "
 						  "false AS aggfinalextra, false AS aggmfinalextra, "
@@ -12281,6 +12520,7 @@ dumpAgg(Archive *fout, DumpOptions *dopt, AggInfo *agginfo)
 
 	i_aggtransfn = PQfnumber(res, "aggtransfn");
 	i_aggfinalfn = PQfnumber(res, "aggfinalfn");
+	i_aggcombinefn = PQfnumber(res, "aggcombinefn");
 	i_aggmtransfn = PQfnumber(res, "aggmtransfn");
 	i_aggminvtransfn = PQfnumber(res, "aggminvtransfn");
 	i_aggmfinalfn = PQfnumber(res, "aggmfinalfn");
@@ -12298,6 +12538,7 @@ dumpAgg(Archive *fout, DumpOptions *dopt, AggInfo *agginfo)
 
 	aggtransfn = PQgetvalue(res, 0, i_aggtransfn);
 	aggfinalfn = PQgetvalue(res, 0, i_aggfinalfn);
+	aggcombinefn = PQgetvalue(res, 0, i_aggcombinefn);
 	aggmtransfn = PQgetvalue(res, 0, i_aggmtransfn);
 	aggminvtransfn = PQgetvalue(res, 0, i_aggminvtransfn);
 	aggmfinalfn = PQgetvalue(res, 0, i_aggmfinalfn);
@@ -12386,6 +12627,12 @@ dumpAgg(Archive *fout, DumpOptions *dopt, AggInfo *agginfo)
 			appendPQExpBufferStr(details, ",\n    FINALFUNC_EXTRA");
 	}
 
+	if (strcmp(aggcombinefn, "-") != 0)
+	{
+		appendPQExpBuffer(details, ",\n    COMBINEFUNC = %s",
+						  aggcombinefn);
+	}
+
 	if (strcmp(aggmtransfn, "-") != 0)
 	{
 		appendPQExpBuffer(details, ",\n    MSFUNC = %s,\n    MINVFUNC = %s,\n    MSTYPE = %s",
@@ -273,6 +273,8 @@ typedef struct _tableDataInfo
 	TableInfo  *tdtable;		/* link to table to dump */
 	bool		oids;			/* include OIDs in data? */
 	char	   *filtercond;		/* WHERE condition to limit rows dumped */
+	int			relpages;		/* estimated size, for ordering */
+	struct _tableDataInfo *nextChunk;	/* next chunk of the table's data */
 } TableDataInfo;
 
 typedef struct _indxInfo
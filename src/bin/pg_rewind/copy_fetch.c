@@ -248,19 +248,33 @@ copy_executeFileMap(filemap_t *map)
 	close_target_file();
 }
 
+/*
+ * Copy the blocks marked in the page map.  Runs of consecutive blocks are
+ * copied in one go.
+ */
 static void
 execute_pagemap(datapagemap_t *pagemap, const char *path)
 {
 	datapagemap_iterator_t *iter;
 	BlockNumber blkno;
+	off_t		runstart = 0;
+	off_t		runend = 0;
 	off_t		offset;
 
 	iter = datapagemap_iterate(pagemap);
 	while (datapagemap_next(iter, &blkno))
 	{
 		offset = blkno * BLCKSZ;
-		copy_file_range(path, offset, offset + BLCKSZ, false);
-		/* Ok, this block has now been copied from new data dir to old */
+		if (offset != runend)
+		{
+			if (runend > runstart)
+				copy_file_range(path, runstart, runend, false);
+			runstart = offset;
+		}
+		runend = offset + BLCKSZ;
 	}
+	if (runend > runstart)
+		copy_file_range(path, runstart, runend, false);
+	/* Ok, these blocks have now been copied from new data dir to old */
 	free(iter);
 }
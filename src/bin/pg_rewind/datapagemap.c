@@ -46,10 +46,13 @@ datapagemap_add(datapagemap_t *map, BlockNumber blkno)
 		 * The minimum to hold the new bit is offset + 1. But add some
 		 * headroom, so that we don't need to repeatedly enlarge the bitmap in
 		 * the common case that blocks are modified in order, from beginning
-		 * of a relation to the end.
+		 * of a relation to the end.  Grow it at least twofold, so that
+		 * mapping a large relation doesn't take quadratic time.
 		 */
 		newsize = offset + 1;
 		newsize += 10;
+		if (newsize < oldsize * 2)
+			newsize = oldsize * 2;
 
 		map->bitmap = pg_realloc(map->bitmap, newsize);
 
@@ -96,6 +99,13 @@ datapagemap_next(datapagemap_iterator_t *iter, BlockNumber *blkno)
 		if (nextoff >= map->bitmapsize)
 			break;
 
+		/* skip over a whole byte at once if no bits are set in it */
+		if (bitno == 0 && map->bitmap[nextoff] == 0)
+		{
+			iter->nextblkno += 8;
+			continue;
+		}
+
 		iter->nextblkno++;
 
 		if (map->bitmap[nextoff] & (1 << bitno))
@@ -338,23 +338,46 @@ process_block_change(ForkNumber forknum, RelFileNode rnode, BlockNumber blkno)
 	filemap_t  *map = filemap;
 	file_entry_t **e;
 
+	/*
+	 * The file looked up last.  Consecutive WAL records very often touch the
+	 * same relation, so this saves constructing the path and searching the
+	 * array for most blocks.
+	 */
+	static bool last_valid = false;
+	static RelFileNode last_rnode;
+	static ForkNumber last_forknum;
+	static int	last_segno;
+	static file_entry_t *last_entry;
+
 	Assert(map->array);
 
 	segno = blkno / RELSEG_SIZE;
 	blkno_inseg = blkno % RELSEG_SIZE;
 
-	path = datasegpath(rnode, forknum, segno);
+	if (last_valid && segno == last_segno && forknum == last_forknum &&
+		RelFileNodeEquals(rnode, last_rnode))
+		entry = last_entry;
+	else
+	{
+		path = datasegpath(rnode, forknum, segno);
 
-	key.path = (char *) path;
-	key_ptr = &key;
+		key.path = (char *) path;
+		key_ptr = &key;
 
-	e = bsearch(&key_ptr, map->array, map->narray, sizeof(file_entry_t *),
-				path_cmp);
-	if (e)
-		entry = *e;
-	else
-		entry = NULL;
-	free(path);
+		e = bsearch(&key_ptr, map->array, map->narray,
+					sizeof(file_entry_t *), path_cmp);
+		if (e)
+			entry = *e;
+		else
+			entry = NULL;
+		free(path);
+
+		last_valid = true;
+		last_rnode = rnode;
+		last_forknum = forknum;
+		last_segno = segno;
+		last_entry = entry;
+	}
 
 	if (entry)
 	{
@@ -14,6 +14,9 @@
 #include <dirent.h>
 #include <fcntl.h>
 #include <unistd.h>
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
 
 /* for ntohl/htonl */
 #include <netinet/in.h>
@@ -35,14 +38,30 @@ static PGconn *conn = NULL;
 /*
  * Files are fetched max CHUNKSIZE bytes at a time.
  *
- * (This only applies to files that are copied in whole, or for truncated
- * files where we copy the tail. Relation files, where we know the individual
- * blocks that need to be fetched, are fetched in BLCKSZ chunks.)
+ * (For relation files, where we know the individual blocks that need to be
+ * fetched, runs of consecutive modified blocks are fetched together, up to
+ * CHUNKSIZE bytes.)
  */
 #define CHUNKSIZE 1000000
 
-static void receiveFileChunks(const char *sql);
-static void execute_pagemap(datapagemap_t *pagemap, const char *path);
+/*
+ * A connection used to fetch file ranges.  With --jobs, the files to fetch
+ * are divided between several connections, so that the source server reads
+ * them in several processes at once.  The first connection is 'conn'.
+ */
+typedef struct FetchSlot
+{
+	PGconn	   *conn;
+	uint64		queued;			/* bytes of file ranges assigned to it */
+	bool		busy;			/* still receiving file chunks? */
+} FetchSlot;
+
+static void receiveFileChunks(FetchSlot *slots, int nslots, const char *sql);
+static void processFileChunk(PGresult *res);
+static void fetch_file_range(FetchSlot *slot, const char *path,
+				 unsigned int begin, unsigned int end);
+static void execute_pagemap(FetchSlot *slot, datapagemap_t *pagemap,
+				const char *path);
 static char *run_simple_query(const char *sql);
 
 void
@@ -195,102 +214,172 @@ libpqProcessFileList(void)
 }
 
 /*----
- * Runs a query, which returns pieces of files from the remote source data
- * directory, and overwrites the corresponding parts of target files with
- * the received parts. The result set is expected to be of format:
+ * Runs a query in each of the given connections, which returns pieces of
+ * files from the remote source data directory, and overwrites the
+ * corresponding parts of target files with the received parts. The result
+ * set is expected to be of format:
  *
  * path		text	-- path in the data directory, e.g "base/1/123"
  * begin	int4	-- offset within the file
  * chunk	bytea	-- file content
+ *
+ * The results of the connections are received as they arrive.
  *----
  */
 static void
-receiveFileChunks(const char *sql)
+receiveFileChunks(FetchSlot *slots, int nslots, const char *sql)
 {
-	PGresult   *res;
-
-	if (PQsendQueryParams(conn, sql, 0, NULL, NULL, NULL, NULL, 1) != 1)
-		pg_fatal("could not send query: %s\n", PQerrorMessage(conn));
-
-	pg_log(PG_DEBUG, "getting file chunks");
-
-	if (PQsetSingleRowMode(conn) != 1)
-		pg_fatal("could not set libpq connection to single row mode\n");
+	int			nbusy = 0;
+	int			i;
 
-	while ((res = PQgetResult(conn)) != NULL)
+	for (i = 0; i < nslots; i++)
 	{
-		char	   *filename;
-		int			filenamelen;
-		int			chunkoff;
-		int			chunksize;
-		char	   *chunk;
+		PGconn	   *slotconn = slots[i].conn;
 
-		switch (PQresultStatus(res))
-		{
-			case PGRES_SINGLE_TUPLE:
-				break;
+		if (PQsendQueryParams(slotconn, sql, 0, NULL, NULL, NULL, NULL, 1) != 1)
+			pg_fatal("could not send query: %s\n", PQerrorMessage(slotconn));
 
-			case PGRES_TUPLES_OK:
-				PQclear(res);
-				continue;		/* final zero-row result */
+		if (PQsetSingleRowMode(slotconn) != 1)
+			pg_fatal("could not set libpq connection to single row mode\n");
 
-			default:
-				pg_fatal("unexpected result while fetching remote files: %s\n",
-						 PQresultErrorMessage(res));
-		}
+		slots[i].busy = true;
+		nbusy++;
+	}
+
+	pg_log(PG_DEBUG, "getting file chunks");
 
-		/* sanity check the result set */
-		if (PQnfields(res) != 3 || PQntuples(res) != 1)
-			pg_fatal("unexpected result set size while fetching remote files\n");
+	while (nbusy > 0)
+	{
+		fd_set		input_mask;
+		int			maxFd = -1;
 
-		if (PQftype(res, 0) != TEXTOID &&
-			PQftype(res, 1) != INT4OID &&
-			PQftype(res, 2) != BYTEAOID)
+		FD_ZERO(&input_mask);
+		for (i = 0; i < nslots; i++)
 		{
-			pg_fatal("unexpected data types in result set while fetching remote files: %u %u %u\n",
-					 PQftype(res, 0), PQftype(res, 1), PQftype(res, 2));
+			int			sock = PQsocket(slots[i].conn);
+
+			if (!slots[i].busy)
+				continue;
+			if (sock < 0)
+				pg_fatal("invalid socket: %s\n",
+						 PQerrorMessage(slots[i].conn));
+			FD_SET(sock, &input_mask);
+			if (sock > maxFd)
+				maxFd = sock;
 		}
 
-		if (PQfformat(res, 0) != 1 &&
-			PQfformat(res, 1) != 1 &&
-			PQfformat(res, 2) != 1)
+		if (select(maxFd + 1, &input_mask, NULL, NULL, NULL) < 0)
 		{
-			pg_fatal("unexpected result format while fetching remote files\n");
+			if (errno == EINTR)
+				continue;
+			pg_fatal("select() failed: %s\n", strerror(errno));
 		}
 
-		if (PQgetisnull(res, 0, 0) ||
-			PQgetisnull(res, 0, 1) ||
-			PQgetisnull(res, 0, 2))
+		for (i = 0; i < nslots; i++)
 		{
-			pg_fatal("unexpected NULL result while fetching remote files\n");
+			PGconn	   *slotconn = slots[i].conn;
+			PGresult   *res;
+
+			if (!slots[i].busy ||
+				!FD_ISSET(PQsocket(slotconn), &input_mask))
+				continue;
+
+			if (PQconsumeInput(slotconn) != 1)
+				pg_fatal("could not receive data from remote server: %s\n",
+						 PQerrorMessage(slotconn));
+
+			/* Process all the chunks that have arrived completely */
+			while (!PQisBusy(slotconn))
+			{
+				res = PQgetResult(slotconn);
+				if (res == NULL)
+				{
+					slots[i].busy = false;
+					nbusy--;
+					break;
+				}
+
+				switch (PQresultStatus(res))
+				{
+					case PGRES_SINGLE_TUPLE:
+						processFileChunk(res);
+						break;
+
+					case PGRES_TUPLES_OK:
+						break;	/* final zero-row result */
+
+					default:
+						pg_fatal("unexpected result while fetching remote files: %s\n",
+								 PQresultErrorMessage(res));
+				}
+
+				PQclear(res);
+			}
 		}
+	}
+}
 
-		if (PQgetlength(res, 0, 1) != sizeof(int32))
-			pg_fatal("unexpected result length while fetching remote files\n");
+/*
+ * Write one received file chunk to the target file.
+ */
+static void
+processFileChunk(PGresult *res)
+{
+	char	   *filename;
+	int			filenamelen;
+	int			chunkoff;
+	int			chunksize;
+	char	   *chunk;
 
-		/* Read result set to local variables */
-		memcpy(&chunkoff, PQgetvalue(res, 0, 1), sizeof(int32));
-		chunkoff = ntohl(chunkoff);
-		chunksize = PQgetlength(res, 0, 2);
+	/* sanity check the result set */
+	if (PQnfields(res) != 3 || PQntuples(res) != 1)
+		pg_fatal("unexpected result set size while fetching remote files\n");
 
-		filenamelen = PQgetlength(res, 0, 0);
-		filename = pg_malloc(filenamelen + 1);
-		memcpy(filename, PQgetvalue(res, 0, 0), filenamelen);
-		filename[filenamelen] = '\0';
+	if (PQftype(res, 0) != TEXTOID &&
+		PQftype(res, 1) != INT4OID &&
+		PQftype(res, 2) != BYTEAOID)
+	{
+		pg_fatal("unexpected data types in result set while fetching remote files: %u %u %u\n",
+				 PQftype(res, 0), PQftype(res, 1), PQftype(res, 2));
+	}
 
-		chunk = PQgetvalue(res, 0, 2);
+	if (PQfformat(res, 0) != 1 &&
+		PQfformat(res, 1) != 1 &&
+		PQfformat(res, 2) != 1)
+	{
+		pg_fatal("unexpected result format while fetching remote files\n");
+	}
 
-		pg_log(PG_DEBUG, "received chunk for file \"%s\", off %d, len %d\n",
-			   filename, chunkoff, chunksize);
+	if (PQgetisnull(res, 0, 0) ||
+		PQgetisnull(res, 0, 1) ||
+		PQgetisnull(res, 0, 2))
+	{
+		pg_fatal("unexpected NULL result while fetching remote files\n");
+	}
 
-		open_target_file(filename, false);
+	if (PQgetlength(res, 0, 1) != sizeof(int32))
+		pg_fatal("unexpected result length while fetching remote files\n");
 
-		write_target_range(chunk, chunkoff, chunksize);
+	/* Read result set to local variables */
+	memcpy(&chunkoff, PQgetvalue(res, 0, 1), sizeof(int32));
+	chunkoff = ntohl(chunkoff);
+	chunksize = PQgetlength(res, 0, 2);
 
-		pg_free(filename);
+	filenamelen = PQgetlength(res, 0, 0);
+	filename = pg_malloc(filenamelen + 1);
+	memcpy(filename, PQgetvalue(res, 0, 0), filenamelen);
+	filename[filenamelen] = '\0';
 
-		PQclear(res);
-	}
+	chunk = PQgetvalue(res, 0, 2);
+
+	pg_log(PG_DEBUG, "received chunk for file \"%s\", off %d, len %d\n",
+		   filename, chunkoff, chunksize);
+
+	open_target_file(filename, false);
+
+	write_target_range(chunk, chunkoff, chunksize);
+
+	pg_free(filename);
 }
 
 /*
@@ -338,7 +427,8 @@ libpqGetFile(const char *filename, size_t *filesize)
  * function to actually fetch the data.
  */
 static void
-fetch_file_range(const char *path, unsigned int begin, unsigned int end)
+fetch_file_range(FetchSlot *slot, const char *path, unsigned int begin,
+				 unsigned int end)
 {
 	char		linebuf[MAXPGPATH + 23];
 
@@ -354,10 +444,11 @@ fetch_file_range(const char *path, unsigned int begin, unsigned int end)
 
 		snprintf(linebuf, sizeof(linebuf), "%s\t%u\t%u\n", path, begin, len);
 
-		if (PQputCopyData(conn, linebuf, strlen(linebuf)) != 1)
+		if (PQputCopyData(slot->conn, linebuf, strlen(linebuf)) != 1)
 			pg_fatal("error sending COPY data: %s\n",
-					 PQerrorMessage(conn));
+					 PQerrorMessage(slot->conn));
 
+		slot->queued += len;
 		begin += len;
 	}
 }
@@ -371,32 +462,69 @@ libpq_executeFileMap(filemap_t *map)
 	file_entry_t *entry;
 	const char *sql;
 	PGresult   *res;
+	FetchSlot  *slots;
+	int			nslots;
 	int			i;
 
 	/*
-	 * First create a temporary table, and load it with the blocks that we
-	 * need to fetch.
+	 * Open the additional connections for --jobs.  They are only used for
+	 * fetching the file ranges.
 	 */
-	sql = "CREATE TEMPORARY TABLE fetchchunks(path text, begin int4, len int4);";
-	res = PQexec(conn, sql);
+	nslots = num_jobs;
+	slots = pg_malloc0(nslots * sizeof(FetchSlot));
+	slots[0].conn = conn;
+	for (i = 1; i < nslots; i++)
+	{
+		slots[i].conn = PQconnectdb(connstr_source);
+		if (PQstatus(slots[i].conn) == CONNECTION_BAD)
+			pg_fatal("could not connect to remote server: %s\n",
+					 PQerrorMessage(slots[i].conn));
+	}
 
-	if (PQresultStatus(res) != PGRES_COMMAND_OK)
-		pg_fatal("error creating temporary table: %s\n",
-				 PQresultErrorMessage(res));
+	/*
+	 * First create a temporary table in each connection, to be loaded with
+	 * the blocks that we need to fetch.
+	 */
+	for (i = 0; i < nslots; i++)
+	{
+		sql = "CREATE TEMPORARY TABLE fetchchunks(path text, begin int4, len int4);";
+		res = PQexec(slots[i].conn, sql);
 
-	sql = "COPY fetchchunks FROM STDIN";
-	res = PQexec(conn, sql);
+		if (PQresultStatus(res) != PGRES_COMMAND_OK)
+			pg_fatal("error creating temporary table: %s\n",
+					 PQresultErrorMessage(res));
+		PQclear(res);
 
-	if (PQresultStatus(res) != PGRES_COPY_IN)
-		pg_fatal("unexpected result while sending file list: %s\n",
-				 PQresultErrorMessage(res));
+		sql = "COPY fetchchunks FROM STDIN";
+		res = PQexec(slots[i].conn, sql);
+
+		if (PQresultStatus(res) != PGRES_COPY_IN)
+			pg_fatal("unexpected result while sending file list: %s\n",
+					 PQresultErrorMessage(res));
+		PQclear(res);
+	}
 
 	for (i = 0; i < map->narray; i++)
 	{
+		FetchSlot  *slot;
+		int			j;
+
 		entry = map->array[i];
 
+		/*
+		 * Assign all the ranges of the file to the connection with the least
+		 * data to fetch so far.  Keeping each file in one connection lets the
+		 * server read it sequentially.
+		 */
+		slot = &slots[0];
+		for (j = 1; j < nslots; j++)
+		{
+			if (slots[j].queued < slot->queued)
+				slot = &slots[j];
+		}
+
 		/* If this is a relation file, copy the modified blocks */
-		execute_pagemap(&entry->pagemap, entry->path);
+		execute_pagemap(slot, &entry->pagemap, entry->path);
 
 		switch (entry->action)
 		{
@@ -407,7 +535,7 @@ libpq_executeFileMap(filemap_t *map)
 			case FILE_ACTION_COPY:
 				/* Truncate the old file out of the way, if any */
 				open_target_file(entry->path, true);
-				fetch_file_range(entry->path, 0, entry->newsize);
+				fetch_file_range(slot, entry->path, 0, entry->newsize);
 				break;
 
 			case FILE_ACTION_TRUNCATE:
@@ -415,7 +543,8 @@ libpq_executeFileMap(filemap_t *map)
 				break;
 
 			case FILE_ACTION_COPY_TAIL:
-				fetch_file_range(entry->path, entry->oldsize, entry->newsize);
+				fetch_file_range(slot, entry->path, entry->oldsize,
+								 entry->newsize);
 				break;
 
 			case FILE_ACTION_REMOVE:
@@ -428,34 +557,51 @@ libpq_executeFileMap(filemap_t *map)
 		}
 	}
 
-	if (PQputCopyEnd(conn, NULL) != 1)
-		pg_fatal("error sending end-of-COPY: %s\n",
-				 PQerrorMessage(conn));
-
-	while ((res = PQgetResult(conn)) != NULL)
+	for (i = 0; i < nslots; i++)
 	{
-		if (PQresultStatus(res) != PGRES_COMMAND_OK)
-			pg_fatal("unexpected result while sending file list: %s\n",
-					 PQresultErrorMessage(res));
+		PGconn	   *slotconn = slots[i].conn;
+
+		if (PQputCopyEnd(slotconn, NULL) != 1)
+			pg_fatal("error sending end-of-COPY: %s\n",
+					 PQerrorMessage(slotconn));
+
+		while ((res = PQgetResult(slotconn)) != NULL)
+		{
+			if (PQresultStatus(res) != PGRES_COMMAND_OK)
+				pg_fatal("unexpected result while sending file list: %s\n",
+						 PQresultErrorMessage(res));
+			PQclear(res);
+		}
 	}
 
 	/*
 	 * We've now copied the list of file ranges that we need to fetch to the
-	 * temporary table. Now, actually fetch all of those ranges.
+	 * temporary tables. Now, actually fetch all of those ranges, in all the
+	 * connections at once.
 	 */
 	sql =
 		"SELECT path, begin, \n"
 		"  pg_read_binary_file(path, begin, len) AS chunk\n"
 		"FROM fetchchunks\n";
 
-	receiveFileChunks(sql);
+	receiveFileChunks(slots, nslots, sql);
+
+	for (i = 1; i < nslots; i++)
+		PQfinish(slots[i].conn);
+	pg_free(slots);
 }
 
+/*
+ * Fetch the blocks marked in the page map.  Runs of consecutive blocks are
+ * fetched as one range, up to CHUNKSIZE bytes.
+ */
 static void
-execute_pagemap(datapagemap_t *pagemap, const char *path)
+execute_pagemap(FetchSlot *slot, datapagemap_t *pagemap, const char *path)
 {
 	datapagemap_iterator_t *iter;
 	BlockNumber blkno;
+	off_t		runstart = 0;
+	off_t		runend = 0;
 	off_t		offset;
 
 	iter = datapagemap_iterate(pagemap);
@@ -463,7 +609,15 @@ execute_pagemap(datapagemap_t *pagemap, const char *path)
 	{
 		offset = blkno * BLCKSZ;
 
-		fetch_file_range(path, offset, offset + BLCKSZ);
+		if (offset != runend || runend - runstart + BLCKSZ > CHUNKSIZE)
+		{
+			if (runend > runstart)
+				fetch_file_range(slot, path, runstart, runend);
+			runstart = offset;
+		}
+		runend = offset + BLCKSZ;
 	}
+	if (runend > runstart)
+		fetch_file_range(slot, path, runstart, runend);
 	free(iter);
 }
@@ -11,6 +11,9 @@
 
 #include "postgres_fe.h"
 
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "pg_rewind.h"
@@ -23,6 +26,8 @@
 #include "catalog/pg_control.h"
 #include "catalog/storage_xlog.h"
 #include "commands/dbcommands_xlog.h"
+#include "port/pg_crc32c.h"
+#include "postmaster/walsummary.h"
 
 
 /*
@@ -38,6 +43,18 @@ static const char *RmgrNames[RM_MAX_ID + 1] = {
 
 static void extractPageInfo(XLogReaderState *record);
 
+/* A WAL summary file found in the target data directory */
+typedef struct WalSummaryRange
+{
+	XLogRecPtr	startptr;
+	XLogRecPtr	endptr;
+} WalSummaryRange;
+
+static XLogRecPtr readWalSummaries(const char *datadir, XLogRecPtr startpoint,
+				 XLogRecPtr endpoint);
+static bool readWalSummary(const char *datadir, WalSummaryRange *range);
+static int	summary_range_cmp(const void *a, const void *b);
+
 static int	xlogreadfd = -1;
 static XLogSegNo xlogreadsegno = -1;
 static char xlogfpath[MAXPGPATH];
@@ -57,6 +74,10 @@ static int SimpleXLogPageRead(XLogReaderState *xlogreader,
  * Read WAL from the datadir/pg_xlog, starting from 'startpoint' on timeline
  * 'tli', until 'endpoint'. Make note of the data blocks touched by the WAL
  * records, and return them in a page map.
+ *
+ * If the WAL summarizer was running in the data directory, the blocks
+ * touched by the WAL its summaries cover are taken from those instead, and
+ * only the rest of the WAL is read.
  */
 void
 extractPageMap(const char *datadir, XLogRecPtr startpoint, TimeLineID tli,
@@ -66,6 +87,22 @@ extractPageMap(const char *datadir, XLogRecPtr startpoint, TimeLineID tli,
 	XLogReaderState *xlogreader;
 	char	   *errormsg;
 	XLogPageReadPrivate private;
+	XLogRecPtr	summarized;
+
+	summarized = readWalSummaries(datadir, startpoint, endpoint);
+	if (summarized > endpoint)
+	{
+		pg_log(PG_PROGRESS, "WAL summaries cover all the WAL to read\n");
+		return;
+	}
+	if (summarized != startpoint)
+	{
+		pg_log(PG_PROGRESS, "WAL summaries cover the WAL up to %X/%X\n",
+			   (uint32) (summarized >> 32), (uint32) summarized);
+
+		/* a summary ends where the next record starts */
+		startpoint = summarized;
+	}
 
 	private.datadir = datadir;
 	private.tli = tli;
@@ -107,6 +144,215 @@ extractPageMap(const char *datadir, XLogRecPtr startpoint, TimeLineID tli,
 	}
 }
 
+/*
+ * Make note of the data blocks modified by the WAL following 'startpoint',
+ * from the chain of WAL summaries that covers it.  Returns the position up
+ * to which the WAL is covered, which is 'startpoint' itself if there are no
+ * usable summaries.
+ *
+ * The summaries also record relation creations and truncations, but like
+ * the corresponding WAL records those can be ignored, see extractPageInfo.
+ */
+static XLogRecPtr
+readWalSummaries(const char *datadir, XLogRecPtr startpoint,
+				 XLogRecPtr endpoint)
+{
+	char		dirpath[MAXPGPATH];
+	DIR		   *dir;
+	struct dirent *de;
+	WalSummaryRange *ranges = NULL;
+	int			nranges = 0;
+	int			maxranges = 0;
+	XLogRecPtr	covered = startpoint;
+	int			i;
+
+	snprintf(dirpath, sizeof(dirpath), "%s/" WAL_SUMMARY_DIR, datadir);
+	dir = opendir(dirpath);
+	if (dir == NULL)
+	{
+		if (errno == ENOENT)
+			return startpoint;
+		pg_fatal("could not open directory \"%s\": %s\n",
+				 dirpath, strerror(errno));
+	}
+
+	while (errno = 0, (de = readdir(dir)) != NULL)
+	{
+		uint32		starthi,
+					startlo,
+					endhi,
+					endlo;
+		char		suffix;
+
+		if (strlen(de->d_name) != 32 + strlen(".summary") ||
+			strcmp(de->d_name + 32, ".summary") != 0 ||
+			sscanf(de->d_name, "%08X%08X%08X%08X%c", &starthi, &startlo,
+				   &endhi, &endlo, &suffix) != 5)
+			continue;
+
+		if (nranges >= maxranges)
+		{
+			maxranges = maxranges ? maxranges * 2 : 64;
+			ranges = pg_realloc(ranges, maxranges * sizeof(WalSummaryRange));
+		}
+		ranges[nranges].startptr = ((uint64) starthi) << 32 | startlo;
+		ranges[nranges].endptr = ((uint64) endhi) << 32 | endlo;
+		nranges++;
+	}
+
+#ifdef WIN32
+
+	/*
+	 * This fix is in mingw cvs (runtime/mingwex/dirent.c rev 1.4), but not in
+	 * released version
+	 */
+	if (GetLastError() == ERROR_NO_MORE_FILES)
+		errno = 0;
+#endif
+
+	if (errno)
+		pg_fatal("could not read directory \"%s\": %s\n",
+				 dirpath, strerror(errno));
+
+	if (closedir(dir))
+		pg_fatal("could not close directory \"%s\": %s\n",
+				 dirpath, strerror(errno));
+
+	if (nranges > 0)
+		qsort(ranges, nranges, sizeof(WalSummaryRange), summary_range_cmp);
+
+	/*
+	 * Follow the chain of summaries from startpoint, until one covers the
+	 * endpoint record.  If a summary can't be read, the WAL from its start
+	 * on is read instead; any blocks it did contribute are merely copied
+	 * needlessly.
+	 */
+	for (i = 0; i < nranges && covered <= endpoint; i++)
+	{
+		if (ranges[i].startptr <= covered && ranges[i].endptr > covered)
+		{
+			if (!readWalSummary(datadir, &ranges[i]))
+				break;
+			covered = ranges[i].endptr;
+		}
+	}
+
+	pg_free(ranges);
+
+	return covered;
+}
+
+/*
+ * Make note of the main fork blocks listed in a WAL summary file.  Returns
+ * false, with a warning, if the file is invalid.
+ */
+static bool
+readWalSummary(const char *datadir, WalSummaryRange *range)
+{
+	char		path[MAXPGPATH];
+	int			fd;
+	struct stat statbuf;
+	char	   *buf;
+	char	   *p;
+	char	   *end;
+	WalSummaryFileHeader hdr;
+	pg_crc32c	crc;
+	pg_crc32c	filecrc;
+	uint32		i;
+
+	snprintf(path, sizeof(path),
+			 "%s/" WAL_SUMMARY_DIR "/%08X%08X%08X%08X.summary", datadir,
+			 (uint32) (range->startptr >> 32), (uint32) range->startptr,
+			 (uint32) (range->endptr >> 32), (uint32) range->endptr);
+
+	fd = open(path, O_RDONLY | PG_BINARY, 0);
+	if (fd < 0)
+		pg_fatal("could not open file \"%s\": %s\n",
+				 path, strerror(errno));
+	if (fstat(fd, &statbuf) < 0)
+		pg_fatal("could not stat file \"%s\": %s\n",
+				 path, strerror(errno));
+	if (statbuf.st_size < sizeof(WalSummaryFileHeader) + sizeof(pg_crc32c))
+	{
+		close(fd);
+		pg_log(PG_WARNING, "invalid WAL summary file \"%s\"\n", path);
+		return false;
+	}
+
+	buf = pg_malloc(statbuf.st_size);
+	if (read(fd, buf, statbuf.st_size) != statbuf.st_size)
+		pg_fatal("could not read file \"%s\": %s\n",
+				 path, strerror(errno));
+	close(fd);
+
+	end = buf + statbuf.st_size - sizeof(pg_crc32c);
+	INIT_CRC32C(crc);
+	COMP_CRC32C(crc, buf, end - buf);
+	FIN_CRC32C(crc);
+	memcpy(&filecrc, end, sizeof(pg_crc32c));
+	memcpy(&hdr, buf, sizeof(hdr));
+	if (!EQ_CRC32C(crc, filecrc) ||
+		hdr.magic != WAL_SUMMARY_MAGIC || hdr.version != WAL_SUMMARY_VERSION)
+	{
+		pg_free(buf);
+		pg_log(PG_WARNING, "invalid WAL summary file \"%s\"\n", path);
+		return false;
+	}
+
+	p = buf + sizeof(hdr);
+	for (i = 0; i < hdr.nentries; i++)
+	{
+		WalSummaryEntry sentry;
+		uint32		j;
+
+		if (p + sizeof(sentry) > end)
+			break;
+		memcpy(&sentry, p, sizeof(sentry));
+		p += sizeof(sentry);
+		if (p + sentry.nblocks * sizeof(BlockNumber) > end)
+			break;
+
+		/* We only care about the main fork; others are copied in toto */
+		if (sentry.forknum != MAIN_FORKNUM ||
+			sentry.rnode.relNode == InvalidOid)
+		{
+			p += sentry.nblocks * sizeof(BlockNumber);
+			continue;
+		}
+
+		for (j = 0; j < sentry.nblocks; j++)
+		{
+			BlockNumber blkno;
+
+			memcpy(&blkno, p, sizeof(BlockNumber));
+			p += sizeof(BlockNumber);
+			process_block_change(MAIN_FORKNUM, sentry.rnode, blkno);
+		}
+	}
+	pg_free(buf);
+
+	if (i < hdr.nentries)
+	{
+		pg_log(PG_WARNING, "invalid WAL summary file \"%s\"\n", path);
+		return false;
+	}
+
+	return true;
+}
+
+static int
+summary_range_cmp(const void *a, const void *b)
+{
+	const WalSummaryRange *ra = (const WalSummaryRange *) a;
+	const WalSummaryRange *rb = (const WalSummaryRange *) b;
+
+	if (ra->startptr != rb->startptr)
+		return (ra->startptr < rb->startptr) ? -1 : 1;
+	if (ra->endptr != rb->endptr)
+		return (ra->endptr < rb->endptr) ? -1 : 1;
+	return 0;
+}
+
 /*
  * Reads one WAL record. Returns the end position of the record, without
  * doing anything with the record itself.
@@ -13,6 +13,9 @@
 #include <fcntl.h>
 #include <time.h>
 #include <unistd.h>
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
 
 #include "pg_rewind.h"
 #include "fetch.h"
@@ -52,6 +55,7 @@ char	   *connstr_source = NULL;
 bool		debug = false;
 bool		showprogress = false;
 bool		dry_run = false;
+int			num_jobs = 1;
 
 static void
 usage(const char *progname)
@@ -67,6 +71,8 @@ usage(const char *progname)
 	printf(_("                 source server to sync with\n"));
 	printf(_("  -P, --progress write progress messages\n"));
 	printf(_("  -n, --dry-run  stop before modifying anything\n"));
+	printf(_("  -j, --jobs=NUM use this many connections to fetch files from\n"
+			 "                 the source server\n"));
 	printf(_("  --debug        write a lot of debug messages\n"));
 	printf(_("  -V, --version  output version information, then exit\n"));
 	printf(_("  -?, --help     show this help, then exit\n"));
@@ -87,6 +93,7 @@ main(int argc, char **argv)
 		{"dry-run", no_argument, NULL, 'n'},
 		{"progress", no_argument, NULL, 'P'},
 		{"debug", no_argument, NULL, 3},
+		{"jobs", required_argument, NULL, 'j'},
 		{NULL, 0, NULL, 0}
 	};
 	int			option_index;
@@ -121,7 +128,7 @@ main(int argc, char **argv)
 		}
 	}
 
-	while ((c = getopt_long(argc, argv, "D:NnP", long_options, &option_index)) != -1)
+	while ((c = getopt_long(argc, argv, "D:j:NnP", long_options, &option_index)) != -1)
 	{
 		switch (c)
 		{
@@ -141,6 +148,21 @@ main(int argc, char **argv)
 				debug = true;
 				break;
 
+			case 'j':
+				num_jobs = atoi(optarg);
+				if (num_jobs <= 0)
+				{
+					fprintf(stderr, _("number of parallel jobs must be at least 1\n"));
+					exit(1);
+				}
+				if (num_jobs > FD_SETSIZE - 1)
+				{
+					fprintf(stderr, _("too many parallel jobs requested (maximum: %d)\n"),
+							FD_SETSIZE - 1);
+					exit(1);
+				}
+				break;
+
 			case 'D':			/* -D or --target-pgdata */
 				datadir_target = pg_strdup(optarg);
 				break;
@@ -162,6 +184,13 @@ main(int argc, char **argv)
 		exit(1);
 	}
 
+	if (num_jobs > 1 && connstr_source == NULL)
+	{
+		fprintf(stderr, _("option --jobs can only be used with --source-server\n"));
+		fprintf(stderr, _("Try \"%s --help\" for more information.\n"), progname);
+		exit(1);
+	}
+
 	if (datadir_target == NULL)
 	{
 		fprintf(stderr, _("no target data directory specified (--target-pgdata)\n"));
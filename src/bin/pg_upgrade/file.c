@@ -11,6 +11,11 @@
 
 #include "pg_upgrade.h"
 
+#include "access/visibilitymap.h"
+#include "storage/bufpage.h"
+#include "storage/checksum.h"
+#include "storage/checksum_impl.h"
+
 #include <fcntl.h>
 
 
@@ -123,6 +128,131 @@ linkAndUpdateFile(pageCnvCtx *pageConverter,
 }
 
 
+/*
+ * rewriteVisibilityMap()
+ *
+ * In versions of PostgreSQL prior to catversion 201510146, PostgreSQL used a
+ * visibility map with one bit per heap page rather than two.  Since the
+ * all-frozen bit didn't exist yet, each old all-visible bit becomes an
+ * all-visible bit with a clear all-frozen bit; every old page therefore
+ * turns into two new ones.  Returns NULL on success, else an error message.
+ */
+const char *
+rewriteVisibilityMap(const char *fromfile, const char *tofile, bool force)
+{
+	int			src_fd = 0;
+	int			dst_fd = 0;
+	char		buffer[BLCKSZ];
+	ssize_t		bytesRead;
+	int			rewriteVmBytesPerPage;
+	BlockNumber new_blkno = 0;
+	const char *msg = NULL;
+
+	/* Each new page holds the bits of this many bytes of an old page */
+	rewriteVmBytesPerPage = (BLCKSZ - SizeOfPageHeaderData) / 2;
+
+	if ((fromfile == NULL) || (tofile == NULL))
+		return "Invalid old file or new file";
+
+	if ((src_fd = open(fromfile, O_RDONLY, 0)) < 0)
+		return getErrorText(errno);
+
+	if ((dst_fd = open(tofile, O_RDWR | O_CREAT | (force ? 0 : O_EXCL), S_IRUSR | S_IWUSR)) < 0)
+	{
+		msg = getErrorText(errno);
+		close(src_fd);
+		return msg;
+	}
+
+	/*
+	 * Turn each visibility map page into 2 pages one by one. Each new page
+	 * has the same page header as the old one.
+	 */
+	while ((bytesRead = read(src_fd, buffer, BLCKSZ)) == BLCKSZ)
+	{
+		char	   *old_cur,
+				   *old_break,
+				   *old_blkend;
+		PageHeaderData pageheader;
+
+		/* Save the page header data */
+		memcpy(&pageheader, buffer, SizeOfPageHeaderData);
+
+		/*
+		 * These old_* variables point to old visibility map page.  old_cur
+		 * points to current position on old page.  old_blkend points to end
+		 * of old block.  old_break points to the position on the old page at
+		 * which the current new page is full; after writing a new page,
+		 * old_break advances by rewriteVmBytesPerPage bytes.
+		 */
+		old_cur = buffer + SizeOfPageHeaderData;
+		old_blkend = buffer + bytesRead;
+		old_break = old_cur + rewriteVmBytesPerPage;
+
+		while (old_blkend >= old_break)
+		{
+			char		new_vmbuf[BLCKSZ];
+			char	   *new_cur = new_vmbuf;
+
+			/* Copy page header in advance */
+			memcpy(new_vmbuf, &pageheader, SizeOfPageHeaderData);
+
+			new_cur += SizeOfPageHeaderData;
+
+			/* Rewrite the visibility map bit for each bit of old byte */
+			while (old_break > old_cur)
+			{
+				uint8		byte = *(uint8 *) old_cur;
+				uint16		new_vmbits = 0;
+				int			i;
+
+				/* Generate new format bits while keeping old information */
+				for (i = 0; i < BITS_PER_BYTE; i++)
+				{
+					if (byte & (1 << i))
+						new_vmbits |= VISIBILITYMAP_ALL_VISIBLE << (BITS_PER_HEAPBLOCK * i);
+				}
+
+				/* Store the low-order heap blocks' bits first */
+				new_cur[0] = (char) (new_vmbits & 0xFF);
+				new_cur[1] = (char) (new_vmbits >> 8);
+
+				old_cur++;
+				new_cur += BITS_PER_HEAPBLOCK;
+			}
+
+			/* Set new checksum for a visibility map page (if enabled) */
+			if (old_cluster.controldata.data_checksum_version != 0 &&
+				new_cluster.controldata.data_checksum_version != 0)
+				((PageHeader) new_vmbuf)->pd_checksum =
+					pg_checksum_page(new_vmbuf, new_blkno);
+
+			if (write(dst_fd, new_vmbuf, BLCKSZ) != BLCKSZ)
+			{
+				msg = "could not write new page to destination";
+				break;
+			}
+
+			old_break += rewriteVmBytesPerPage;
+			new_blkno++;
+		}
+
+		if (msg)
+			break;
+	}
+
+	close(src_fd);
+	close(dst_fd);
+
+	if (msg)
+		return msg;
+	else if (bytesRead != 0)
+		return "found partial page in source file";
+	else
+		return NULL;
+}
+
+
 #ifndef WIN32
 static int
 copy_file(const char *srcfile, const char *dstfile, bool force)
@@ -43,7 +43,7 @@ typedef struct
 	DbInfoArr  *new_db_arr;
 	char	   *old_pgdata;
 	char	   *new_pgdata;
-	char	   *old_tablespace;
+	int			part;
 } transfer_thread_arg;
 
 exec_thread_arg **exec_thread_args;
@@ -175,12 +175,11 @@ win32_exec_prog(exec_thread_arg *args)
  *	parallel_transfer_all_new_dbs
  *
  *	This has the same API as transfer_all_new_dbs, except it does parallel execution
- *	by transferring multiple tablespaces in parallel
+ *	by transferring part 'part' of user_opts.jobs parts of the relations
  */
 void
 parallel_transfer_all_new_dbs(DbInfoArr *old_db_arr, DbInfoArr *new_db_arr,
-							  char *old_pgdata, char *new_pgdata,
-							  char *old_tablespace)
+							  char *old_pgdata, char *new_pgdata, int part)
 {
 #ifndef WIN32
 	pid_t		child;
@@ -191,7 +190,7 @@ parallel_transfer_all_new_dbs(DbInfoArr *old_db_arr, DbInfoArr *new_db_arr,
 
 	if (user_opts.jobs <= 1)
 		/* throw_error must be true to allow jobs */
-		transfer_all_new_dbs(old_db_arr, new_db_arr, old_pgdata, new_pgdata, NULL);
+		transfer_all_new_dbs(old_db_arr, new_db_arr, old_pgdata, new_pgdata, 0, 1);
 	else
 	{
 		/* parallel */
@@ -235,7 +234,7 @@ parallel_transfer_all_new_dbs(DbInfoArr *old_db_arr, DbInfoArr *new_db_arr,
 		if (child == 0)
 		{
 			transfer_all_new_dbs(old_db_arr, new_db_arr, old_pgdata, new_pgdata,
-								 old_tablespace);
+								 part, user_opts.jobs);
 			/* if we take another exit path, it will be non-zero */
 			/* use _exit to skip atexit() functions */
 			_exit(0);
@@ -256,9 +255,7 @@ parallel_transfer_all_new_dbs(DbInfoArr *old_db_arr, DbInfoArr *new_db_arr,
 		if (new_arg->new_pgdata)
 			pg_free(new_arg->new_pgdata);
 		new_arg->new_pgdata = pg_strdup(new_pgdata);
-		if (new_arg->old_tablespace)
-			pg_free(new_arg->old_tablespace);
-		new_arg->old_tablespace = old_tablespace ? pg_strdup(old_tablespace) : NULL;
+		new_arg->part = part;
 
 		child = (HANDLE) _beginthreadex(NULL, 0, (void *) win32_transfer_all_new_dbs,
 										new_arg, 0, NULL);
@@ -278,7 +275,7 @@ DWORD
 win32_transfer_all_new_dbs(transfer_thread_arg *args)
 {
 	transfer_all_new_dbs(args->old_db_arr, args->new_db_arr, args->old_pgdata,
-						 args->new_pgdata, args->old_tablespace);
+						 args->new_pgdata, args->part, user_opts.jobs);
 
 	/* terminates thread */
 	return 0;
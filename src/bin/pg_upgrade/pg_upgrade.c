@@ -299,32 +299,74 @@ static void
 create_new_objects(void)
 {
 	int			dbnum;
+	int			txn_size;
+	off_t	   *dump_sizes;
+	off_t		total_size = 0;
 
 	prep_status("Restoring database schemas in the new cluster\n");
 
+	/*
+	 * Restore the objects in transactions of many objects each, rather than
+	 * one transaction per object, which is slow with many relations.  With
+	 * several restores running at once, make the transactions smaller so
+	 * that their locks still fit in the lock table.
+	 */
+	txn_size = RESTORE_TRANSACTION_SIZE;
+	if (user_opts.jobs > 1)
+		txn_size = Max(RESTORE_TRANSACTION_SIZE / user_opts.jobs, 10);
+
+	/*
+	 * The databases are restored in parallel, but often one of them holds
+	 * almost all of the schema.  So also give each pg_restore a share of the
+	 * jobs in proportion to the size of its dump, for the post-data items of
+	 * big databases to be restored in parallel too.  This can briefly use a
+	 * few more connections than user_opts.jobs.
+	 */
+	dump_sizes = (off_t *) pg_malloc0(old_cluster.dbarr.ndbs * sizeof(off_t));
+	for (dbnum = 0; dbnum < old_cluster.dbarr.ndbs; dbnum++)
+	{
+		char		sql_file_name[MAXPGPATH];
+		struct stat st;
+
+		snprintf(sql_file_name, sizeof(sql_file_name), DB_DUMP_FILE_MASK,
+				 old_cluster.dbarr.dbs[dbnum].db_oid);
+		if (stat(sql_file_name, &st) == 0)
+			dump_sizes[dbnum] = st.st_size;
+		total_size += dump_sizes[dbnum];
+	}
+
 	for (dbnum = 0; dbnum < old_cluster.dbarr.ndbs; dbnum++)
 	{
 		char		sql_file_name[MAXPGPATH],
 					log_file_name[MAXPGPATH];
 		DbInfo	   *old_db = &old_cluster.dbarr.dbs[dbnum];
+		int			restore_jobs = 1;
 
 		pg_log(PG_STATUS, "%s", old_db->db_name);
 		snprintf(sql_file_name, sizeof(sql_file_name), DB_DUMP_FILE_MASK, old_db->db_oid);
 		snprintf(log_file_name, sizeof(log_file_name), DB_DUMP_LOG_FILE_MASK, old_db->db_oid);
 
+		if (user_opts.jobs > 1 && total_size > 0)
+			restore_jobs = Max((int) ((double) user_opts.jobs *
+									  dump_sizes[dbnum] / total_size), 1);
+
 		/*
 		 * pg_dump only produces its output at the end, so there is little
 		 * parallelism if using the pipe.
 		 */
 		parallel_exec_prog(log_file_name,
 						   NULL,
-						   "\"%s/pg_restore\" %s --exit-on-error --verbose --dbname \"%s\" \"%s\"",
+						   "\"%s/pg_restore\" %s --exit-on-error --transaction-size=%d --jobs=%d --verbose --dbname \"%s\" \"%s\"",
 						   new_cluster.bindir,
 						   cluster_conn_opts(&new_cluster),
+						   txn_size,
+						   restore_jobs,
 						   old_db->db_name,
 						   sql_file_name);
 	}
 
+	pg_free(dump_sizes);
+
 	/* reap all children */
 	while (reap_child(true) == true)
 		;
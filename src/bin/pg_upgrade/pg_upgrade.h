@@ -33,6 +33,9 @@
 #define DB_DUMP_FILE_MASK	"pg_upgrade_dump_%u.custom"
 
 #define DB_DUMP_LOG_FILE_MASK	"pg_upgrade_dump_%u.log"
+
+/* number of objects pg_restore restores per transaction, see create_new_objects */
+#define RESTORE_TRANSACTION_SIZE	1000
 #define SERVER_LOG_FILE		"pg_upgrade_server.log"
 #define UTILITY_LOG_FILE	"pg_upgrade_utility.log"
 #define INTERNAL_LOG_FILE	"pg_upgrade_internal.log"
@@ -130,6 +133,12 @@ extern char *output_files[];
  */
 #define JSONB_FORMAT_CHANGE_CAT_VER 201409291
 
+/*
+ * The visibility map grew an all-frozen bit per heap page, changing its
+ * format; old maps have to be rewritten rather than copied or linked.
+ */
+#define VISIBILITY_MAP_FROZEN_BIT_CAT_VER 201510146
+
 /*
  * Each relation is represented by a relinfo structure.
  */
@@ -400,6 +409,8 @@ const char *copyAndUpdateFile(pageCnvCtx *pageConverter, const char *src,
 				  const char *dst, bool force);
 const char *linkAndUpdateFile(pageCnvCtx *pageConverter, const char *src,
 				  const char *dst);
+const char *rewriteVisibilityMap(const char *fromfile, const char *tofile,
+					 bool force);
 
 void		check_hard_link(void);
 FILE	   *fopen_priv(const char *path, const char *mode);
@@ -431,7 +442,7 @@ void transfer_all_new_tablespaces(DbInfoArr *old_db_arr,
 				  DbInfoArr *new_db_arr, char *old_pgdata, char *new_pgdata);
 void transfer_all_new_dbs(DbInfoArr *old_db_arr,
 				   DbInfoArr *new_db_arr, char *old_pgdata, char *new_pgdata,
-					 char *old_tablespace);
+					 int part, int nparts);
 
 /* tablespace.c */
 
@@ -477,6 +488,5 @@ void		old_9_3_check_for_line_data_type_usage(ClusterInfo *cluster);
 void parallel_exec_prog(const char *log_file, const char *opt_log_file,
 				   const char *fmt,...) pg_attribute_printf(3, 4);
 void parallel_transfer_all_new_dbs(DbInfoArr *old_db_arr, DbInfoArr *new_db_arr,
-							  char *old_pgdata, char *new_pgdata,
-							  char *old_tablespace);
+							  char *old_pgdata, char *new_pgdata, int part);
 bool		reap_child(bool wait_for_child);
@@ -16,9 +16,10 @@
 
 
 static void transfer_single_new_db(pageCnvCtx *pageConverter,
-					   FileNameMap *maps, int size, char *old_tablespace);
+					   FileNameMap *maps, int size, int relnum,
+					   int part, int nparts);
 static void transfer_relfile(pageCnvCtx *pageConverter, FileNameMap *map,
-				 const char *suffix);
+				 const char *suffix, bool vm_must_add_frozenbit);
 
 
 /*
@@ -35,29 +36,22 @@ transfer_all_new_tablespaces(DbInfoArr *old_db_arr, DbInfoArr *new_db_arr,
 	  user_opts.transfer_mode == TRANSFER_MODE_LINK ? "Linking" : "Copying");
 
 	/*
-	 * Transferring files by tablespace is tricky because a single database
-	 * can use multiple tablespaces.  For non-parallel mode, we just pass a
-	 * NULL tablespace path, which matches all tablespaces.  In parallel mode,
-	 * we pass the default tablespace and all user-created tablespaces and let
-	 * those operations happen in parallel.
+	 * In parallel mode, each job transfers every user_opts.jobs'th relation,
+	 * counting across all databases.  Splitting the work by relation rather
+	 * than by tablespace keeps all jobs busy even when everything is in the
+	 * default tablespace, which is the usual case, and the relations of each
+	 * tablespace still end up being transferred by all jobs in parallel.
 	 */
 	if (user_opts.jobs <= 1)
 		parallel_transfer_all_new_dbs(old_db_arr, new_db_arr, old_pgdata,
-									  new_pgdata, NULL);
+									  new_pgdata, 0);
 	else
 	{
-		int			tblnum;
+		int			part;
 
-		/* transfer default tablespace */
-		parallel_transfer_all_new_dbs(old_db_arr, new_db_arr, old_pgdata,
-									  new_pgdata, old_pgdata);
-
-		for (tblnum = 0; tblnum < os_info.num_old_tablespaces; tblnum++)
-			parallel_transfer_all_new_dbs(old_db_arr,
-										  new_db_arr,
-										  old_pgdata,
-										  new_pgdata,
-										  os_info.old_tablespaces[tblnum]);
+		for (part = 0; part < user_opts.jobs; part++)
+			parallel_transfer_all_new_dbs(old_db_arr, new_db_arr, old_pgdata,
+										  new_pgdata, part);
 		/* reap all children */
 		while (reap_child(true) == true)
 			;
@@ -74,14 +68,16 @@ transfer_all_new_tablespaces(DbInfoArr *old_db_arr, DbInfoArr *new_db_arr,
  * transfer_all_new_dbs()
  *
  * Responsible for upgrading all database. invokes routines to generate mappings and then
- * physically link the databases.
+ * physically link the databases.  Only relation number 'part', 'part' +
+ * 'nparts' and so on, counting across all databases, are transferred.
  */
 void
 transfer_all_new_dbs(DbInfoArr *old_db_arr, DbInfoArr *new_db_arr,
-					 char *old_pgdata, char *new_pgdata, char *old_tablespace)
+					 char *old_pgdata, char *new_pgdata, int part, int nparts)
 {
 	int			old_dbnum,
 				new_dbnum;
+	int			relnum = 0;
 
 	/* Scan the old cluster databases and transfer their files */
 	for (old_dbnum = new_dbnum = 0;
@@ -114,13 +110,15 @@ transfer_all_new_dbs(DbInfoArr *old_db_arr, DbInfoArr *new_db_arr,
 									new_pgdata);
 		if (n_maps)
 		{
-			print_maps(mappings, n_maps, new_db->db_name);
+			if (part == 0)
+				print_maps(mappings, n_maps, new_db->db_name);
 
 #ifdef PAGE_CONVERSION
 			pageConverter = setupPageConverter();
 #endif
-			transfer_single_new_db(pageConverter, mappings, n_maps,
-								   old_tablespace);
+			transfer_single_new_db(pageConverter, mappings, n_maps, relnum,
+								   part, nparts);
+			relnum += n_maps;
 		}
 		/* We allocate something even for n_maps == 0 */
 		pg_free(mappings);
@@ -163,14 +161,17 @@ get_pg_database_relfilenode(ClusterInfo *cluster)
 /*
  * transfer_single_new_db()
  *
- * create links for mappings stored in "maps" array.
+ * create links for mappings stored in "maps" array, which are relation
+ * numbers 'relnum' and onwards, for those that belong to part 'part'.
  */
 static void
 transfer_single_new_db(pageCnvCtx *pageConverter,
-					   FileNameMap *maps, int size, char *old_tablespace)
+					   FileNameMap *maps, int size, int relnum,
+					   int part, int nparts)
 {
 	int			mapnum;
 	bool		vm_crashsafe_match = true;
+	bool		vm_must_add_frozenbit = false;
 
 	/*
 	 * Do the old and new cluster disagree on the crash-safetiness of the vm
@@ -180,13 +181,19 @@ transfer_single_new_db(pageCnvCtx *pageConverter,
 		new_cluster.controldata.cat_ver >= VISIBILITY_MAP_CRASHSAFE_CAT_VER)
 		vm_crashsafe_match = false;
 
+	/*
+	 * Do we need to rewrite visibilitymap?
+	 */
+	if (old_cluster.controldata.cat_ver < VISIBILITY_MAP_FROZEN_BIT_CAT_VER &&
+		new_cluster.controldata.cat_ver >= VISIBILITY_MAP_FROZEN_BIT_CAT_VER)
+		vm_must_add_frozenbit = true;
+
 	for (mapnum = 0; mapnum < size; mapnum++)
 	{
-		if (old_tablespace == NULL ||
-			strcmp(maps[mapnum].old_tablespace, old_tablespace) == 0)
+		if ((relnum + mapnum) % nparts == part)
 		{
 			/* transfer primary file */
-			transfer_relfile(pageConverter, &maps[mapnum], "");
+			transfer_relfile(pageConverter, &maps[mapnum], "", false);
 
 			/* fsm/vm files added in PG 8.4 */
 			if (GET_MAJOR_VERSION(old_cluster.major_version) >= 804)
@@ -194,9 +201,10 @@ transfer_single_new_db(pageCnvCtx *pageConverter,
 				/*
 				 * Copy/link any fsm and vm files, if they exist
 				 */
-				transfer_relfile(pageConverter, &maps[mapnum], "_fsm");
+				transfer_relfile(pageConverter, &maps[mapnum], "_fsm", false);
 				if (vm_crashsafe_match)
-					transfer_relfile(pageConverter, &maps[mapnum], "_vm");
+					transfer_relfile(pageConverter, &maps[mapnum], "_vm",
+									 vm_must_add_frozenbit);
 			}
 		}
 	}
@@ -206,11 +214,13 @@ transfer_single_new_db(pageCnvCtx *pageConverter,
 /*
  * transfer_relfile()
  *
- * Copy or link file from old cluster to new one.
+ * Copy or link file from old cluster to new one.  If vm_must_add_frozenbit
+ * is true, the file is an old-format visibility map and is rewritten to the
+ * current format instead, regardless of the transfer mode.
  */
 static void
 transfer_relfile(pageCnvCtx *pageConverter, FileNameMap *map,
-				 const char *type_suffix)
+				 const char *type_suffix, bool vm_must_add_frozenbit)
 {
 	const char *msg;
 	char		old_file[MAXPGPATH];
@@ -272,7 +282,15 @@ transfer_relfile(pageCnvCtx *pageConverter, FileNameMap *map,
 			pg_fatal("This upgrade requires page-by-page conversion, "
 					 "you must use copy mode instead of link mode.\n");
 
-		if (user_opts.transfer_mode == TRANSFER_MODE_COPY)
+		if (vm_must_add_frozenbit)
+		{
+			pg_log(PG_VERBOSE, "rewriting \"%s\" to \"%s\"\n", old_file, new_file);
+
+			if ((msg = rewriteVisibilityMap(old_file, new_file, true)) != NULL)
+				pg_fatal("error while rewriting relation \"%s.%s\" (\"%s\" to \"%s\"): %s\n",
+						 map->nspname, map->relname, old_file, new_file, msg);
+		}
+		else if (user_opts.transfer_mode == TRANSFER_MODE_COPY)
 		{
 			pg_log(PG_VERBOSE, "copying \"%s\" to \"%s\"\n", old_file, new_file);
 
@@ -15,6 +15,12 @@
 #include <dirent.h>
 #include <unistd.h>
 
+/* --jobs needs threads; on platforms without them, only one job is allowed */
+#if defined(ENABLE_THREAD_SAFETY) && !defined(WIN32)
+#include <pthread.h>
+#define XLOGDUMP_USE_THREADS
+#endif
+
 #include "access/xlogreader.h"
 #include "access/xlogrecord.h"
 #include "access/xlog_internal.h"
@@ -33,6 +39,11 @@ typedef struct XLogDumpPrivate
 	XLogRecPtr	startptr;
 	XLogRecPtr	endptr;
 	bool		endptr_reached;
+
+	/* segment file currently open, see XLogDumpXLogRead */
+	int			sendFile;
+	XLogSegNo	sendSegNo;
+	uint32		sendOff;
 } XLogDumpPrivate;
 
 typedef struct XLogDumpConfig
@@ -44,6 +55,7 @@ typedef struct XLogDumpConfig
 	bool		follow;
 	bool		stats;
 	bool		stats_per_record;
+	bool		stats_per_relation;
 
 	/* filter options */
 	int			filter_by_rmgr;
@@ -60,13 +72,56 @@ typedef struct Stats
 
 #define MAX_XLINFO_TYPES 16
 
+/*
+ * Per-relation statistics are kept in a simple open-addressing hash table,
+ * keyed by relfilenode.  Entries are never removed.
+ */
+typedef struct RelStatsEntry
+{
+	RelFileNode rnode;
+	bool		used;
+	Stats		stats;
+} RelStatsEntry;
+
+typedef struct RelStatsTable
+{
+	uint32		size;			/* number of entries, a power of 2 */
+	uint32		nused;			/* number of entries in use */
+	RelStatsEntry *entries;
+} RelStatsTable;
+
 typedef struct XLogDumpStats
 {
 	uint64		count;
 	Stats		rmgr_stats[RM_NEXT_ID];
 	Stats		record_stats[RM_NEXT_ID][MAX_XLINFO_TYPES];
+	RelStatsTable rel_stats;
+	Stats		norel_stats;	/* records without block references */
 } XLogDumpStats;
 
+/*
+ * State of one reader of WAL.  Normally there is just one, reading all of
+ * the requested range.  With --jobs, the range is split at segment
+ * boundaries, and a thread reads the records starting in each part; their
+ * statistics are added up at the end.
+ */
+typedef struct XLogDumpWorker
+{
+	XLogDumpPrivate private;	/* our own copy, with our own open file */
+	XLogDumpConfig *config;
+	XLogRecPtr	stopptr;		/* stop at the first record starting at or
+								 * after this; InvalidXLogRecPtr if we're
+								 * reading to the end */
+	bool		first;			/* reading the first part of the range? */
+	XLogDumpStats stats;
+	bool		complete;		/* read all of our part? */
+	char	   *errormsg;		/* error that made us stop, if any */
+	XLogRecPtr	errptr;			/* and where it happened */
+#ifdef XLOGDUMP_USE_THREADS
+	pthread_t	thread;
+#endif
+} XLogDumpWorker;
+
 static void fatal_error(const char *fmt,...) pg_attribute_printf(1, 2);
 
 /*
@@ -218,22 +273,21 @@ fuzzy_open_file(const char *directory, const char *fname)
 }
 
 /*
- * Read count bytes from a segment file in the specified directory, for the
- * given timeline, containing the specified record pointer; store the data in
- * the passed buffer.
+ * Read count bytes from a segment file in the directory given by private,
+ * for its timeline, containing the specified record pointer; store the data
+ * in the passed buffer.  The segment file is kept open in private for the
+ * next call.
  */
 static void
-XLogDumpXLogRead(const char *directory, TimeLineID timeline_id,
-				 XLogRecPtr startptr, char *buf, Size count)
+XLogDumpXLogRead(XLogDumpPrivate *private, XLogRecPtr startptr, char *buf,
+				 Size count)
 {
+	const char *directory = private->inpath;
+	TimeLineID	timeline_id = private->timeline;
 	char	   *p;
 	XLogRecPtr	recptr;
 	Size		nbytes;
 
-	static int	sendFile = -1;
-	static XLogSegNo sendSegNo = 0;
-	static uint32 sendOff = 0;
-
 	p = buf;
 	recptr = startptr;
 	nbytes = count;
@@ -246,40 +300,40 @@ XLogDumpXLogRead(const char *directory, TimeLineID timeline_id,
 
 		startoff = recptr % XLogSegSize;
 
-		if (sendFile < 0 || !XLByteInSeg(recptr, sendSegNo))
+		if (private->sendFile < 0 || !XLByteInSeg(recptr, private->sendSegNo))
 		{
 			char		fname[MAXFNAMELEN];
 
 			/* Switch to another logfile segment */
-			if (sendFile >= 0)
-				close(sendFile);
+			if (private->sendFile >= 0)
+				close(private->sendFile);
 
-			XLByteToSeg(recptr, sendSegNo);
+			XLByteToSeg(recptr, private->sendSegNo);
 
-			XLogFileName(fname, timeline_id, sendSegNo);
+			XLogFileName(fname, timeline_id, private->sendSegNo);
 
-			sendFile = fuzzy_open_file(directory, fname);
+			private->sendFile = fuzzy_open_file(directory, fname);
 
-			if (sendFile < 0)
+			if (private->sendFile < 0)
 				fatal_error("could not find file \"%s\": %s",
 							fname, strerror(errno));
-			sendOff = 0;
+			private->sendOff = 0;
 		}
 
 		/* Need to seek in the file? */
-		if (sendOff != startoff)
+		if (private->sendOff != startoff)
 		{
-			if (lseek(sendFile, (off_t) startoff, SEEK_SET) < 0)
+			if (lseek(private->sendFile, (off_t) startoff, SEEK_SET) < 0)
 			{
 				int			err = errno;
 				char		fname[MAXPGPATH];
 
-				XLogFileName(fname, timeline_id, sendSegNo);
+				XLogFileName(fname, timeline_id, private->sendSegNo);
 
 				fatal_error("could not seek in log segment %s to offset %u: %s",
 							fname, startoff, strerror(err));
 			}
-			sendOff = startoff;
+			private->sendOff = startoff;
 		}
 
 		/* How many bytes are within this segment? */
@@ -288,22 +342,22 @@ XLogDumpXLogRead(const char *directory, TimeLineID timeline_id,
 		else
 			segbytes = nbytes;
 
-		readbytes = read(sendFile, p, segbytes);
+		readbytes = read(private->sendFile, p, segbytes);
 		if (readbytes <= 0)
 		{
 			int			err = errno;
 			char		fname[MAXPGPATH];
 
-			XLogFileName(fname, timeline_id, sendSegNo);
+			XLogFileName(fname, timeline_id, private->sendSegNo);
 
 			fatal_error("could not read from log segment %s, offset %d, length %d: %s",
-						fname, sendOff, segbytes, strerror(err));
+						fname, private->sendOff, segbytes, strerror(err));
 		}
 
 		/* Update state for read */
 		recptr += readbytes;
 
-		sendOff += readbytes;
+		private->sendOff += readbytes;
 		nbytes -= readbytes;
 		p += readbytes;
 	}
@@ -332,14 +386,138 @@ XLogDumpReadPage(XLogReaderState *state, XLogRecPtr targetPagePtr, int reqLen,
 		}
 	}
 
-	XLogDumpXLogRead(private->inpath, private->timeline, targetPagePtr,
-					 readBuff, count);
+	XLogDumpXLogRead(private, targetPagePtr, readBuff, count);
 
 	return count;
 }
 
 /*
- * Store per-rmgr and per-record statistics for a given record.
+ * Hash function for relfilenodes.  The mixing steps are the finalizer of
+ * MurmurHash3, so that nearby relfilenodes land far apart.
+ */
+static uint32
+rel_stats_hash(const RelFileNode *rnode)
+{
+	uint32		h;
+
+	h = rnode->relNode;
+	h = h * 31 + rnode->dbNode;
+	h = h * 31 + rnode->spcNode;
+
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+
+	return h;
+}
+
+static void rel_stats_grow(RelStatsTable *table);
+
+/*
+ * Find the statistics of a relation, adding a zeroed entry if it isn't
+ * there yet.  The result is only valid until the next call.
+ */
+static Stats *
+XLogDumpRelStats(RelStatsTable *table, const RelFileNode *rnode)
+{
+	uint32		mask;
+	uint32		i;
+
+	/* keep the table at most 3/4 full */
+	if (table->nused >= table->size / 4 * 3)
+		rel_stats_grow(table);
+
+	mask = table->size - 1;
+	i = rel_stats_hash(rnode) & mask;
+
+	for (;;)
+	{
+		RelStatsEntry *entry = &table->entries[i];
+
+		if (!entry->used)
+		{
+			entry->used = true;
+			entry->rnode = *rnode;
+			table->nused++;
+			return &entry->stats;
+		}
+
+		if (RelFileNodeEquals(entry->rnode, *rnode))
+			return &entry->stats;
+
+		i = (i + 1) & mask;
+	}
+}
+
+/*
+ * Double the size of a relation statistics table, or create it if empty.
+ */
+static void
+rel_stats_grow(RelStatsTable *table)
+{
+	RelStatsTable newtable;
+	uint32		i;
+
+	newtable.size = table->size > 0 ? table->size * 2 : 1024;
+	newtable.nused = 0;
+	newtable.entries = pg_malloc0(newtable.size * sizeof(RelStatsEntry));
+
+	for (i = 0; i < table->size; i++)
+	{
+		RelStatsEntry *entry = &table->entries[i];
+
+		if (entry->used)
+			*XLogDumpRelStats(&newtable, &entry->rnode) = entry->stats;
+	}
+
+	if (table->entries)
+		pg_free(table->entries);
+	*table = newtable;
+}
+
+static void
+XLogDumpAddStats(Stats *dst, const Stats *src)
+{
+	dst->count += src->count;
+	dst->rec_len += src->rec_len;
+	dst->fpi_len += src->fpi_len;
+}
+
+/*
+ * Add the statistics gathered in src to dst.
+ */
+static void
+XLogDumpMergeStats(XLogDumpStats *dst, const XLogDumpStats *src)
+{
+	int			ri,
+				rj;
+	uint32		i;
+
+	dst->count += src->count;
+
+	for (ri = 0; ri < RM_NEXT_ID; ri++)
+	{
+		XLogDumpAddStats(&dst->rmgr_stats[ri], &src->rmgr_stats[ri]);
+		for (rj = 0; rj < MAX_XLINFO_TYPES; rj++)
+			XLogDumpAddStats(&dst->record_stats[ri][rj],
+							 &src->record_stats[ri][rj]);
+	}
+
+	for (i = 0; i < src->rel_stats.size; i++)
+	{
+		const RelStatsEntry *entry = &src->rel_stats.entries[i];
+
+		if (entry->used)
+			XLogDumpAddStats(XLogDumpRelStats(&dst->rel_stats, &entry->rnode),
+							 &entry->stats);
+	}
+	XLogDumpAddStats(&dst->norel_stats, &src->norel_stats);
+}
+
+/*
+ * Store per-rmgr, per-record and per-relation statistics for a given record.
  */
 static void
 XLogDumpCountRecord(XLogDumpConfig *config, XLogDumpStats *stats,
@@ -354,7 +532,6 @@ XLogDumpCountRecord(XLogDumpConfig *config, XLogDumpStats *stats,
 	stats->count++;
 
 	rmid = XLogRecGetRmid(record);
-	rec_len = XLogRecGetDataLen(record) + SizeOfXLogRecord;
 
 	/*
 	 * Calculate the amount of FPI data in the record.
@@ -370,6 +547,12 @@ XLogDumpCountRecord(XLogDumpConfig *config, XLogDumpStats *stats,
 			fpi_len += record->blocks[block_id].bimg_len;
 	}
 
+	/*
+	 * Everything else counts as record data: the header, the block headers
+	 * and data, and the main data.
+	 */
+	rec_len = XLogRecGetTotalLen(record) - fpi_len;
+
 	/* Update per-rmgr statistics */
 
 	stats->rmgr_stats[rmid].count++;
@@ -388,6 +571,46 @@ XLogDumpCountRecord(XLogDumpConfig *config, XLogDumpStats *stats,
 	stats->record_stats[rmid][recid].count++;
 	stats->record_stats[rmid][recid].rec_len += rec_len;
 	stats->record_stats[rmid][recid].fpi_len += fpi_len;
+
+	/*
+	 * Update per-relation statistics.  Each full-page image is charged to
+	 * the relation it is of, and the rest of the record to the relation of
+	 * its first block reference.  Records without block references, such as
+	 * commit records, are counted separately.
+	 */
+	if (config->stats_per_relation)
+	{
+		bool		charged = false;
+
+		for (block_id = 0; block_id <= record->max_block_id; block_id++)
+		{
+			RelFileNode rnode;
+			ForkNumber	forknum;
+			BlockNumber blk;
+			Stats	   *relstats;
+
+			if (!XLogRecHasBlockRef(record, block_id))
+				continue;
+
+			XLogRecGetBlockTag(record, block_id, &rnode, &forknum, &blk);
+			relstats = XLogDumpRelStats(&stats->rel_stats, &rnode);
+
+			if (!charged)
+			{
+				relstats->count++;
+				relstats->rec_len += rec_len;
+				charged = true;
+			}
+			if (XLogRecHasBlockImage(record, block_id))
+				relstats->fpi_len += record->blocks[block_id].bimg_len;
+		}
+
+		if (!charged)
+		{
+			stats->norel_stats.count++;
+			stats->norel_stats.rec_len += rec_len;
+		}
+	}
 }
 
 /*
@@ -462,15 +685,28 @@ XLogDumpDisplayRecord(XLogDumpConfig *config, XLogReaderState *record)
 				   blk);
 			if (XLogRecHasBlockImage(record, block_id))
 			{
-				if (record->blocks[block_id].bimg_info &
-					BKPIMAGE_IS_COMPRESSED)
+				uint8		bimg_info = record->blocks[block_id].bimg_info;
+
+				if (BKPIMAGE_COMPRESSED(bimg_info))
 				{
-					printf(" (FPW); hole: offset: %u, length: %u, compression saved: %u\n",
+					const char *method;
+
+					if (bimg_info & BKPIMAGE_COMPRESS_PGLZ)
+						method = "pglz";
+					else if (bimg_info & BKPIMAGE_COMPRESS_LZ4)
+						method = "lz4";
+					else if (bimg_info & BKPIMAGE_COMPRESS_ZSTD)
+						method = "zstd";
+					else
+						method = "unknown";
+
+					printf(" (FPW); hole: offset: %u, length: %u, compression saved: %u, method: %s\n",
 						   record->blocks[block_id].hole_offset,
 						   record->blocks[block_id].hole_length,
 						   BLCKSZ -
 						   record->blocks[block_id].hole_length -
-						   record->blocks[block_id].bimg_len);
+						   record->blocks[block_id].bimg_len,
+						   method);
 				}
 				else
 				{
@@ -525,6 +761,71 @@ XLogDumpStatsRow(const char *name,
 }
 
 
+/*
+ * qsort comparator for RelStatsEntry pointers, by combined size, descending
+ */
+static int
+rel_stats_cmp(const void *a, const void *b)
+{
+	const Stats *sa = &(*(RelStatsEntry *const *) a)->stats;
+	const Stats *sb = &(*(RelStatsEntry *const *) b)->stats;
+	uint64		la = sa->rec_len + sa->fpi_len;
+	uint64		lb = sb->rec_len + sb->fpi_len;
+
+	if (la > lb)
+		return -1;
+	if (la < lb)
+		return 1;
+	return 0;
+}
+
+/*
+ * Display the rows of per-relation statistics, the relations generating the
+ * most WAL first.
+ */
+static void
+XLogDumpDisplayRelStats(XLogDumpStats *stats,
+						uint64 total_count, uint64 total_rec_len,
+						uint64 total_fpi_len, uint64 total_len)
+{
+	RelStatsTable *table = &stats->rel_stats;
+	RelStatsEntry **sorted;
+	uint32		nsorted = 0;
+	uint32		i;
+
+	sorted = pg_malloc(Max(table->nused, 1) * sizeof(RelStatsEntry *));
+	for (i = 0; i < table->size; i++)
+	{
+		if (table->entries[i].used)
+			sorted[nsorted++] = &table->entries[i];
+	}
+	qsort(sorted, nsorted, sizeof(RelStatsEntry *), rel_stats_cmp);
+
+	for (i = 0; i < nsorted; i++)
+	{
+		RelStatsEntry *entry = sorted[i];
+
+		XLogDumpStatsRow(psprintf("%u/%u/%u",
+								  entry->rnode.spcNode,
+								  entry->rnode.dbNode,
+								  entry->rnode.relNode),
+						 entry->stats.count, total_count,
+						 entry->stats.rec_len, total_rec_len,
+						 entry->stats.fpi_len, total_fpi_len,
+						 entry->stats.rec_len + entry->stats.fpi_len,
+						 total_len);
+	}
+
+	if (stats->norel_stats.count > 0)
+		XLogDumpStatsRow("(no relation)",
+						 stats->norel_stats.count, total_count,
+						 stats->norel_stats.rec_len, total_rec_len,
+						 0, total_fpi_len,
+						 stats->norel_stats.rec_len, total_len);
+
+	pg_free(sorted);
+}
+
 /*
  * Display summary statistics about the records seen so far.
  */
@@ -543,8 +844,8 @@ XLogDumpDisplayStats(XLogDumpConfig *config, XLogDumpStats *stats)
 	/* ---
 	 * Make a first pass to calculate column totals:
 	 * count(*),
-	 * sum(xl_len+SizeOfXLogRecord),
-	 * sum(xl_tot_len-xl_len-SizeOfXLogRecord), and
+	 * sum(xl_tot_len-fpi_len),
+	 * sum(fpi_len), and
 	 * sum(xl_tot_len).
 	 * These are used to calculate percentages for each record type.
 	 * ---
@@ -565,52 +866,60 @@ XLogDumpDisplayStats(XLogDumpConfig *config, XLogDumpStats *stats)
 
 	printf("%-27s %20s %8s %20s %8s %20s %8s %20s %8s\n"
 		   "%-27s %20s %8s %20s %8s %20s %8s %20s %8s\n",
-		   "Type", "N", "(%)", "Record size", "(%)", "FPI size", "(%)", "Combined size", "(%)",
-		   "----", "-", "---", "-----------", "---", "--------", "---", "-------------", "---");
-
-	for (ri = 0; ri < RM_NEXT_ID; ri++)
+		   config->stats_per_relation ? "Relation" : "Type",
+		   "N", "(%)", "Record size", "(%)", "FPI size", "(%)", "Combined size", "(%)",
+		   config->stats_per_relation ? "--------" : "----",
+		   "-", "---", "-----------", "---", "--------", "---", "-------------", "---");
+
+	if (config->stats_per_relation)
+		XLogDumpDisplayRelStats(stats, total_count, total_rec_len,
+								total_fpi_len, total_len);
+	else
 	{
-		uint64		count,
-					rec_len,
-					fpi_len,
-					tot_len;
-		const RmgrDescData *desc = &RmgrDescTable[ri];
-
-		if (!config->stats_per_record)
+		for (ri = 0; ri < RM_NEXT_ID; ri++)
 		{
-			count = stats->rmgr_stats[ri].count;
-			rec_len = stats->rmgr_stats[ri].rec_len;
-			fpi_len = stats->rmgr_stats[ri].fpi_len;
-			tot_len = rec_len + fpi_len;
-
-			XLogDumpStatsRow(desc->rm_name,
-							 count, total_count, rec_len, total_rec_len,
-							 fpi_len, total_fpi_len, tot_len, total_len);
-		}
-		else
-		{
-			for (rj = 0; rj < MAX_XLINFO_TYPES; rj++)
-			{
-				const char *id;
+			uint64		count,
+						rec_len,
+						fpi_len,
+						tot_len;
+			const RmgrDescData *desc = &RmgrDescTable[ri];
 
-				count = stats->record_stats[ri][rj].count;
-				rec_len = stats->record_stats[ri][rj].rec_len;
-				fpi_len = stats->record_stats[ri][rj].fpi_len;
+			if (!config->stats_per_record)
+			{
+				count = stats->rmgr_stats[ri].count;
+				rec_len = stats->rmgr_stats[ri].rec_len;
+				fpi_len = stats->rmgr_stats[ri].fpi_len;
 				tot_len = rec_len + fpi_len;
 
-				/* Skip undefined combinations and ones that didn't occur */
-				if (count == 0)
-					continue;
-
-				/* the upper four bits in xl_info are the rmgr's */
-				id = desc->rm_identify(rj << 4);
-				if (id == NULL)
-					id = psprintf("UNKNOWN (%x)", rj << 4);
-
-				XLogDumpStatsRow(psprintf("%s/%s", desc->rm_name, id),
+				XLogDumpStatsRow(desc->rm_name,
 								 count, total_count, rec_len, total_rec_len,
 								 fpi_len, total_fpi_len, tot_len, total_len);
 			}
+			else
+			{
+				for (rj = 0; rj < MAX_XLINFO_TYPES; rj++)
+				{
+					const char *id;
+
+					count = stats->record_stats[ri][rj].count;
+					rec_len = stats->record_stats[ri][rj].rec_len;
+					fpi_len = stats->record_stats[ri][rj].fpi_len;
+					tot_len = rec_len + fpi_len;
+
+					/* Skip undefined combinations and ones that didn't occur */
+					if (count == 0)
+						continue;
+
+					/* the upper four bits in xl_info are the rmgr's */
+					id = desc->rm_identify(rj << 4);
+					if (id == NULL)
+						id = psprintf("UNKNOWN (%x)", rj << 4);
+
+					XLogDumpStatsRow(psprintf("%s/%s", desc->rm_name, id),
+									 count, total_count, rec_len, total_rec_len,
+									 fpi_len, total_fpi_len, tot_len, total_len);
+				}
+			}
 		}
 	}
 
@@ -643,6 +952,116 @@ XLogDumpDisplayStats(XLogDumpConfig *config, XLogDumpStats *stats)
 		   total_len, "[100%]");
 }
 
+/*
+ * Read and process the records in a worker's part of the WAL.  This is the
+ * main loop, run directly or, with --jobs, in a thread of its own.
+ */
+static void *
+XLogDumpWorkerMain(void *arg)
+{
+	XLogDumpWorker *worker = (XLogDumpWorker *) arg;
+	XLogDumpPrivate *private = &worker->private;
+	XLogDumpConfig *config = worker->config;
+	XLogReaderState *xlogreader_state;
+	XLogRecord *record;
+	XLogRecPtr	first_record;
+	char	   *errormsg = NULL;
+
+	xlogreader_state = XLogReaderAllocate(XLogDumpReadPage, private);
+	if (!xlogreader_state)
+		fatal_error("out of memory");
+
+	/* first find a valid recptr to start from */
+	first_record = XLogFindNextRecord(xlogreader_state, private->startptr);
+
+	if (first_record == InvalidXLogRecPtr)
+	{
+		if (worker->first)
+			fatal_error("could not find a valid record after %X/%X",
+						(uint32) (private->startptr >> 32),
+						(uint32) private->startptr);
+
+		/* valid WAL must have ended in an earlier part */
+		XLogReaderFree(xlogreader_state);
+		return NULL;
+	}
+
+	/*
+	 * Display a message that we're skipping data if `from` wasn't a pointer
+	 * to the start of a record and also wasn't a pointer to the beginning of
+	 * a segment (e.g. we were used in file mode).
+	 */
+	if (worker->first &&
+		first_record != private->startptr &&
+		(private->startptr % XLogSegSize) != 0)
+		printf("first record is after %X/%X, at %X/%X, skipping over %u bytes\n",
+			   (uint32) (private->startptr >> 32), (uint32) private->startptr,
+			   (uint32) (first_record >> 32), (uint32) first_record,
+			   (uint32) (first_record - private->startptr));
+
+	for (;;)
+	{
+		/* try to read the next record */
+		record = XLogReadRecord(xlogreader_state, first_record, &errormsg);
+		if (!record)
+		{
+			if (!config->follow || private->endptr_reached)
+				break;
+			else
+			{
+				pg_usleep(1000000L);	/* 1 second */
+				continue;
+			}
+		}
+
+		/* after reading the first record, continue at next one */
+		first_record = InvalidXLogRecPtr;
+
+		/* the records from here on are the next worker's */
+		if (!XLogRecPtrIsInvalid(worker->stopptr) &&
+			xlogreader_state->ReadRecPtr >= worker->stopptr)
+		{
+			worker->complete = true;
+			break;
+		}
+
+		/* apply all specified filters */
+		if (config->filter_by_rmgr != -1 &&
+			config->filter_by_rmgr != record->xl_rmid)
+			continue;
+
+		if (config->filter_by_xid_enabled &&
+			config->filter_by_xid != record->xl_xid)
+			continue;
+
+		/* process the record */
+		if (config->stats == true)
+			XLogDumpCountRecord(config, &worker->stats, xlogreader_state);
+		else
+			XLogDumpDisplayRecord(config, xlogreader_state);
+
+		/* check whether we printed enough */
+		config->already_displayed_records++;
+		if (config->stop_after_records > 0 &&
+			config->already_displayed_records >= config->stop_after_records)
+			break;
+	}
+
+	/* the last part ends wherever the WAL does */
+	if (XLogRecPtrIsInvalid(worker->stopptr))
+		worker->complete = true;
+
+	if (errormsg)
+	{
+		worker->errormsg = pg_strdup(errormsg);
+		worker->errptr = xlogreader_state->ReadRecPtr;
+	}
+
+	XLogReaderFree(xlogreader_state);
+
+	return NULL;
+}
+
 static void
 usage(void)
 {
@@ -654,6 +1073,7 @@ usage(void)
 	printf("  -b, --bkp-details      output detailed information about backup blocks\n");
 	printf("  -e, --end=RECPTR       stop reading at log position RECPTR\n");
 	printf("  -f, --follow           keep retrying after reaching end of WAL\n");
+	printf("  -j, --jobs=NUM         use this many threads to read WAL for --stats\n");
 	printf("  -n, --limit=N          number of records to display\n");
 	printf("  -p, --path=PATH        directory in which to find log segment files\n");
 	printf("                         (default: ./pg_xlog)\n");
@@ -664,8 +1084,10 @@ usage(void)
 	printf("                         (default: 1 or the value used in STARTSEG)\n");
 	printf("  -V, --version          output version information, then exit\n");
 	printf("  -x, --xid=XID          only show records with TransactionId XID\n");
-	printf("  -z, --stats[=record]   show statistics instead of records\n");
-	printf("                         (optionally, show per-record statistics)\n");
+	printf("  -z, --stats[=record|relation]\n");
+	printf("                         show statistics instead of records\n");
+	printf("                         (optionally, show per-record or per-relation\n");
+	printf("                         statistics)\n");
 	printf("  -?, --help             show this help, then exit\n");
 }
 
@@ -674,19 +1096,21 @@ main(int argc, char **argv)
 {
 	uint32		xlogid;
 	uint32		xrecoff;
-	XLogReaderState *xlogreader_state;
 	XLogDumpPrivate private;
 	XLogDumpConfig config;
 	XLogDumpStats stats;
-	XLogRecord *record;
-	XLogRecPtr	first_record;
-	char	   *errormsg;
+	XLogDumpWorker *workers;
+	int			njobs = 1;
+	int			i;
+	char	   *errormsg = NULL;
+	XLogRecPtr	errptr = InvalidXLogRecPtr;
 
 	static struct option long_options[] = {
 		{"bkp-details", no_argument, NULL, 'b'},
 		{"end", required_argument, NULL, 'e'},
 		{"follow", no_argument, NULL, 'f'},
 		{"help", no_argument, NULL, '?'},
+		{"jobs", required_argument, NULL, 'j'},
 		{"limit", required_argument, NULL, 'n'},
 		{"path", required_argument, NULL, 'p'},
 		{"rmgr", required_argument, NULL, 'r'},
@@ -711,6 +1135,7 @@ main(int argc, char **argv)
 	private.startptr = InvalidXLogRecPtr;
 	private.endptr = InvalidXLogRecPtr;
 	private.endptr_reached = false;
+	private.sendFile = -1;
 
 	config.bkp_details = false;
 	config.stop_after_records = -1;
@@ -721,6 +1146,7 @@ main(int argc, char **argv)
 	config.filter_by_xid_enabled = false;
 	config.stats = false;
 	config.stats_per_record = false;
+	config.stats_per_relation = false;
 
 	if (argc <= 1)
 	{
@@ -728,7 +1154,7 @@ main(int argc, char **argv)
 		goto bad_argument;
 	}
 
-	while ((option = getopt_long(argc, argv, "be:?fn:p:r:s:t:Vx:z",
+	while ((option = getopt_long(argc, argv, "be:?fj:n:p:r:s:t:Vx:z",
 								 long_options, &optindex)) != -1)
 	{
 		switch (option)
@@ -752,6 +1178,14 @@ main(int argc, char **argv)
 				usage();
 				exit(EXIT_SUCCESS);
 				break;
+			case 'j':
+				if (sscanf(optarg, "%d", &njobs) != 1 || njobs < 1)
+				{
+					fprintf(stderr, "%s: invalid number of jobs \"%s\"\n",
+							progname, optarg);
+					goto bad_argument;
+				}
+				break;
 			case 'n':
 				if (sscanf(optarg, "%d", &config.stop_after_records) != 1)
 				{
@@ -824,10 +1258,13 @@ main(int argc, char **argv)
 			case 'z':
 				config.stats = true;
 				config.stats_per_record = false;
+				config.stats_per_relation = false;
 				if (optarg)
 				{
 					if (strcmp(optarg, "record") == 0)
 						config.stats_per_record = true;
+					else if (strcmp(optarg, "relation") == 0)
+						config.stats_per_relation = true;
 					else if (strcmp(optarg, "rmgr") != 0)
 					{
 						fprintf(stderr, "%s: unrecognised argument to --stats: %s\n",
@@ -953,69 +1390,118 @@ main(int argc, char **argv)
 		goto bad_argument;
 	}
 
+	if (njobs > 1)
+	{
+#ifndef XLOGDUMP_USE_THREADS
+		fprintf(stderr, "%s: --jobs is not supported on this platform\n",
+				progname);
+		goto bad_argument;
+#endif
+		if (!config.stats)
+		{
+			fprintf(stderr, "%s: --jobs can only be used with --stats\n",
+					progname);
+			goto bad_argument;
+		}
+		if (config.follow || config.stop_after_records > 0)
+		{
+			fprintf(stderr, "%s: --jobs cannot be used with --follow or --limit\n",
+					progname);
+			goto bad_argument;
+		}
+		if (XLogRecPtrIsInvalid(private.endptr))
+		{
+			fprintf(stderr, "%s: --jobs requires an end log position or ENDSEG\n",
+					progname);
+			goto bad_argument;
+		}
+	}
+
 	/* done with argument parsing, do the actual work */
 
-	/* we have everything we need, start reading */
-	xlogreader_state = XLogReaderAllocate(XLogDumpReadPage, &private);
-	if (!xlogreader_state)
-		fatal_error("out of memory");
+	/*
+	 * With --jobs, split the range to read at segment boundaries, giving
+	 * each thread at least one segment.  Each reads the records that start
+	 * in its part; the last record it reads may continue into the next part,
+	 * whose reader skips over that using XLogFindNextRecord().
+	 */
+	if (njobs > 1)
+	{
+		XLogSegNo	startsegno;
+		XLogSegNo	endsegno;
 
-	/* first find a valid recptr to start from */
-	first_record = XLogFindNextRecord(xlogreader_state, private.startptr);
+		XLByteToSeg(private.startptr, startsegno);
+		XLByteToPrevSeg(private.endptr, endsegno);
 
-	if (first_record == InvalidXLogRecPtr)
-		fatal_error("could not find a valid record after %X/%X",
-					(uint32) (private.startptr >> 32),
-					(uint32) private.startptr);
+		if (endsegno < startsegno)
+			njobs = 1;
+		else if (endsegno - startsegno + 1 < njobs)
+			njobs = endsegno - startsegno + 1;
 
-	/*
-	 * Display a message that we're skipping data if `from` wasn't a pointer
-	 * to the start of a record and also wasn't a pointer to the beginning of
-	 * a segment (e.g. we were used in file mode).
-	 */
-	if (first_record != private.startptr && (private.startptr % XLogSegSize) != 0)
-		printf("first record is after %X/%X, at %X/%X, skipping over %u bytes\n",
-			   (uint32) (private.startptr >> 32), (uint32) private.startptr,
-			   (uint32) (first_record >> 32), (uint32) first_record,
-			   (uint32) (first_record - private.startptr));
+		workers = pg_malloc0(njobs * sizeof(XLogDumpWorker));
+		for (i = 0; i < njobs; i++)
+		{
+			XLogSegNo	nsegs = endsegno - startsegno + 1;
+
+			workers[i].private = private;
+			if (i > 0)
+				XLogSegNoOffsetToRecPtr(startsegno + nsegs * i / njobs, 0,
+										workers[i].private.startptr);
+			if (i < njobs - 1)
+				XLogSegNoOffsetToRecPtr(startsegno + nsegs * (i + 1) / njobs, 0,
+										workers[i].stopptr);
+		}
+	}
+	else
+	{
+		workers = pg_malloc0(sizeof(XLogDumpWorker));
+		workers[0].private = private;
+	}
 
-	for (;;)
+	for (i = 0; i < njobs; i++)
 	{
-		/* try to read the next record */
-		record = XLogReadRecord(xlogreader_state, first_record, &errormsg);
-		if (!record)
+		workers[i].config = &config;
+		workers[i].first = (i == 0);
+	}
+
+	if (njobs == 1)
+		XLogDumpWorkerMain(&workers[0]);
+#ifdef XLOGDUMP_USE_THREADS
+	else
+	{
+		for (i = 0; i < njobs; i++)
 		{
-			if (!config.follow || private.endptr_reached)
-				break;
-			else
-			{
-				pg_usleep(1000000L);	/* 1 second */
-				continue;
-			}
-		}
+			int			err;
 
-		/* after reading the first record, continue at next one */
-		first_record = InvalidXLogRecPtr;
+			err = pthread_create(&workers[i].thread, NULL,
+								 XLogDumpWorkerMain, &workers[i]);
+			if (err != 0)
+				fatal_error("could not create thread: %s", strerror(err));
+		}
 
-		/* apply all specified filters */
-		if (config.filter_by_rmgr != -1 &&
-			config.filter_by_rmgr != record->xl_rmid)
-			continue;
+		for (i = 0; i < njobs; i++)
+		{
+			int			err;
 
-		if (config.filter_by_xid_enabled &&
-			config.filter_by_xid != record->xl_xid)
-			continue;
+			err = pthread_join(workers[i].thread, NULL);
+			if (err != 0)
+				fatal_error("could not join thread: %s", strerror(err));
+		}
+	}
+#endif
 
-		/* process the record */
-		if (config.stats == true)
-			XLogDumpCountRecord(&config, &stats, xlogreader_state);
-		else
-			XLogDumpDisplayRecord(&config, xlogreader_state);
+	/*
+	 * Add up the statistics of the parts, in order, until one that didn't
+	 * reach its end, because that's where the valid WAL ends.  Report the
+	 * error that stopped it, if any, as if we had read serially.
+	 */
+	for (i = 0; i < njobs; i++)
+	{
+		XLogDumpMergeStats(&stats, &workers[i].stats);
+		errormsg = workers[i].errormsg;
+		errptr = workers[i].errptr;
 
-		/* check whether we printed enough */
-		config.already_displayed_records++;
-		if (config.stop_after_records > 0 &&
-			config.already_displayed_records >= config.stop_after_records)
+		if (!workers[i].complete)
 			break;
 	}
 
@@ -1024,12 +1510,10 @@ main(int argc, char **argv)
 
 	if (errormsg)
 		fatal_error("error in WAL record at %X/%X: %s\n",
-					(uint32) (xlogreader_state->ReadRecPtr >> 32),
-					(uint32) xlogreader_state->ReadRecPtr,
+					(uint32) (errptr >> 32),
+					(uint32) errptr,
 					errormsg);
 
-	XLogReaderFree(xlogreader_state);
-
 	return EXIT_SUCCESS;
 
 bad_argument:
@@ -38,6 +38,7 @@
 #include "portability/instr_time.h"
 
 #include <ctype.h>
+#include <limits.h>
 #include <math.h>
 #include <signal.h>
 #include <sys/time.h>
@@ -181,6 +182,7 @@ int			progress_nthreads = 0;		/* number of threads for progress
 										 * report */
 bool		is_connect;			/* establish connection for each transaction */
 bool		is_latencies;		/* report per-command latencies */
+bool		use_pipeline;		/* send runs of SQL commands as a pipeline */
 int			main_pid;			/* main process id used in log filename */
 
 char	   *pghost = "";
@@ -225,9 +227,32 @@ typedef struct
 	int64		txn_sqlats;		/* cumulated square latencies */
 	bool		is_throttled;	/* whether transaction throttling is done */
 	int			use_file;		/* index in sql_files for this client */
+	int			pipeline_next;	/* in pipeline mode, commands before this
+								 * index have been sent; 0 if none */
 	bool		prepared[MAX_FILES];
 } CState;
 
+/*
+ * Latency histogram, in the style of HdrHistogram: values below
+ * LATENCY_HIST_SUB microseconds are counted exactly, and each power of two
+ * above that is split into LATENCY_HIST_SUB linear buckets, so that the
+ * relative error of a reported percentile is below 1 / LATENCY_HIST_SUB
+ * whatever the magnitude of the latencies.  Histograms are kept per thread
+ * without locking and merged for reporting.
+ */
+#define LATENCY_HIST_SUB_BITS	5
+#define LATENCY_HIST_SUB		(1 << LATENCY_HIST_SUB_BITS)
+#define LATENCY_HIST_MAX_BITS	40	/* cover up to 2^40 usec, about 12 days */
+#define LATENCY_HIST_BUCKETS \
+	(LATENCY_HIST_SUB * (LATENCY_HIST_MAX_BITS - LATENCY_HIST_SUB_BITS + 1))
+
+typedef struct
+{
+	int64		count;			/* number of values recorded */
+	int64		max;			/* largest value recorded (usec) */
+	int64		buckets[LATENCY_HIST_BUCKETS];
+} LatencyHist;
+
 /*
  * Thread state and result
  */
@@ -240,6 +265,9 @@ typedef struct
 	instr_time	start_time;		/* thread start time */
 	instr_time *exec_elapsed;	/* time spent executing cmds (per Command) */
 	int		   *exec_count;		/* number of cmd executions (per Command) */
+	LatencyHist *exec_hist;		/* cmd latencies (per Command) */
+	LatencyHist *latency_hist;	/* transaction latencies */
+	LatencyHist *file_hist;		/* transaction latencies (per script file) */
 	unsigned short random_state[3];		/* separate randomness for each thread */
 	int64		throttle_trigger;		/* previous/next throttling (us) */
 	int64		throttle_lag;	/* total transaction lag behind throttling */
@@ -313,9 +341,14 @@ typedef struct
 } AggVals;
 
 static Command **sql_files[MAX_FILES];	/* SQL script files */
+static const char *sql_file_names[MAX_FILES];	/* file or builtin name */
+static const char *sql_file_types[MAX_FILES];	/* transaction type shown */
+static int	sql_file_weights[MAX_FILES];	/* relative selection weights */
+static int64 total_weight = 0;	/* sum of sql_file_weights */
 static int	num_files;			/* number of script files */
 static int	num_commands = 0;	/* total number of Command structs */
 static int	debug = 0;			/* debug flag */
+static bool use_latency_hist = true;	/* report latency percentiles? */
 
 /* default scenario */
 static char *tpc_b = {
@@ -358,9 +391,32 @@ static char *select_only = {
 	"SELECT abalance FROM pgbench_accounts WHERE aid = :aid;\n"
 };
 
+/* built-in scripts that can be selected with -b */
+typedef struct
+{
+	const char *name;			/* name for -b */
+	const char *source;			/* name shown in messages */
+	const char *type;			/* transaction type shown in results */
+	char	  **script;			/* script text */
+} BuiltinScript;
+
+static const BuiltinScript builtin_script[] =
+{
+	{"tpcb-like", "<builtin: TPC-B (sort of)>", "TPC-B (sort of)", &tpc_b},
+	{"simple-update", "<builtin: simple update>",
+	"Update only pgbench_accounts", &simple_update},
+	{"select-only", "<builtin: select only>", "SELECT only", &select_only}
+};
+
 /* Function prototypes */
 static void setalarm(int seconds);
 static void *threadRun(void *arg);
+static void hist_record(LatencyHist *hist, int64 value);
+static void hist_merge(LatencyHist *dst, const LatencyHist *src);
+static void hist_interval(LatencyHist *interval, const LatencyHist *cur,
+			  LatencyHist *last);
+static void print_hist_percentiles(FILE *out, const LatencyHist *hist);
+static int	chooseScript(TState *thread);
 
 static void doLog(TState *thread, CState *st, FILE *logfile, instr_time *now,
 	  AggVals *agg, bool skipped);
@@ -387,7 +443,9 @@ usage(void)
 		   "  -C, --connect            establish new connection for each transaction\n"
 		   "  -D, --define=VARNAME=VALUE\n"
 	  "                           define variable for use by custom script\n"
-		 "  -f, --file=FILENAME      read transaction script from FILENAME\n"
+		   "  -b, --builtin=NAME[@W]   add builtin script NAME with weight W (default: 1)\n"
+		   "                           (use \"-b list\" to list available scripts)\n"
+		   "  -f, --file=FILENAME[@W]  add script FILENAME with weight W (default: 1)\n"
 		   "  -j, --jobs=NUM           number of threads (default: 1)\n"
 		   "  -l, --log                write transaction times to log file\n"
 	"  -L, --latency-limit=NUM  count transactions lasting more than NUM ms\n"
@@ -405,6 +463,7 @@ usage(void)
 		 "  -T, --time=NUM           duration of benchmark test in seconds\n"
 		   "  -v, --vacuum-all         vacuum all four standard tables before tests\n"
 		   "  --aggregate-interval=NUM aggregate data over NUM seconds\n"
+		   "  --pipeline               send consecutive SQL commands as a pipeline\n"
 		   "  --sampling-rate=NUM      fraction of transactions to log (e.g. 0.01 for 1%%)\n"
 		   "\nCommon options:\n"
 		   "  -d, --debug              print debugging output\n"
@@ -1100,6 +1159,87 @@ preparedStatementName(char *buffer, int file, int state)
 	sprintf(buffer, "P%d_%d", file, state);
 }
 
+/*
+ * Prepare all the SQL commands of the client's current script, if that has
+ * not been done yet on this connection.
+ */
+static void
+prepareScript(CState *st, Command **commands)
+{
+	int			j;
+
+	if (st->prepared[st->use_file])
+		return;
+
+	for (j = 0; commands[j] != NULL; j++)
+	{
+		PGresult   *res;
+		char		name[MAX_PREPARE_NAME];
+
+		if (commands[j]->type != SQL_COMMAND)
+			continue;
+		preparedStatementName(name, st->use_file, j);
+		res = PQprepare(st->con, name,
+						commands[j]->argv[0], commands[j]->argc - 1, NULL);
+		if (PQresultStatus(res) != PGRES_COMMAND_OK)
+			fprintf(stderr, "%s", PQerrorMessage(st->con));
+		PQclear(res);
+	}
+	st->prepared[st->use_file] = true;
+}
+
+/*
+ * Send one SQL command, number cnum of the client's current script, in the
+ * selected query mode.  Returns 0 on failure, like the libpq send functions.
+ */
+static int
+sendCommand(CState *st, const Command *command, int cnum)
+{
+	int			r;
+
+	if (querymode == QUERY_SIMPLE)
+	{
+		char	   *sql;
+
+		sql = pg_strdup(command->argv[0]);
+		sql = assignVariables(st, sql);
+
+		if (debug)
+			fprintf(stderr, "client %d sending %s\n", st->id, sql);
+		r = PQsendQuery(st->con, sql);
+		free(sql);
+	}
+	else if (querymode == QUERY_EXTENDED)
+	{
+		const char *sql = command->argv[0];
+		const char *params[MAX_ARGS];
+
+		getQueryParams(st, command, params);
+
+		if (debug)
+			fprintf(stderr, "client %d sending %s\n", st->id, sql);
+		r = PQsendQueryParams(st->con, sql, command->argc - 1,
+							  NULL, params, NULL, NULL, 0);
+	}
+	else if (querymode == QUERY_PREPARED)
+	{
+		char		name[MAX_PREPARE_NAME];
+		const char *params[MAX_ARGS];
+
+		getQueryParams(st, command, params);
+		preparedStatementName(name, st->use_file, cnum);
+
+		if (debug)
+			fprintf(stderr, "client %d sending %s\n", st->id, name);
+		r = PQsendQueryPrepared(st->con, name, command->argc - 1,
+								params, NULL, NULL, 0);
+	}
+	else	/* unknown sql mode */
+		r = 0;
+
+	return r;
+}
+
 static bool
 clientDone(CState *st, bool ok)
 {
@@ -1259,19 +1399,24 @@ top:
 		if (is_latencies)
 		{
 			int			cnum = commands[st->state]->command_num;
+			instr_time	diff;
 
 			if (INSTR_TIME_IS_ZERO(now))
 				INSTR_TIME_SET_CURRENT(now);
-			INSTR_TIME_ACCUM_DIFF(thread->exec_elapsed[cnum],
-								  now, st->stmt_begin);
+			diff = now;
+			INSTR_TIME_SUBTRACT(diff, st->stmt_begin);
+			INSTR_TIME_ADD(thread->exec_elapsed[cnum], diff);
 			thread->exec_count[cnum]++;
+			if (thread->exec_hist)
+				hist_record(&thread->exec_hist[cnum],
+							INSTR_TIME_GET_MICROSEC(diff));
 		}
 
 		/* transaction finished: calculate latency and log the transaction */
 		if (commands[st->state + 1] == NULL)
 		{
 			/* only calculate latency if an option is used that needs it */
-			if (progress || throttle_delay || latency_limit)
+			if (progress || throttle_delay || latency_limit || is_latencies)
 			{
 				int64		latency;
 
@@ -1294,6 +1439,13 @@ top:
 				/* record over the limit transactions if needed. */
 				if (latency_limit && latency > latency_limit)
 					thread->latency_late++;
+
+				/* and feed the histograms for percentiles */
+				if (thread->latency_hist)
+				{
+					hist_record(thread->latency_hist, latency);
+					hist_record(&thread->file_hist[st->use_file], latency);
+				}
 			}
 
 			/* record the time it took in the log */
@@ -1321,6 +1473,28 @@ top:
 			}
 			PQclear(res);
 			discard_response(st);
+
+			/* after the last result of a pipeline, wait for its sync */
+			if (st->pipeline_next > 0 && st->state + 1 == st->pipeline_next)
+			{
+				res = PQgetResult(st->con);
+				if (PQresultStatus(res) != PGRES_PIPELINE_SYNC)
+				{
+					fprintf(stderr, "Client %d aborted in state %d: unexpected result at end of pipeline: %s",
+							st->id, st->state, PQerrorMessage(st->con));
+					PQclear(res);
+					return clientDone(st, false);
+				}
+				PQclear(res);
+				discard_response(st);
+				if (!PQexitPipelineMode(st->con))
+				{
+					fprintf(stderr, "Client %d aborted in state %d: %s",
+							st->id, st->state, PQerrorMessage(st->con));
+					return clientDone(st, false);
+				}
+				st->pipeline_next = 0;
+			}
 		}
 
 		if (commands[st->state + 1] == NULL)
@@ -1341,7 +1515,7 @@ top:
 		if (commands[st->state] == NULL)
 		{
 			st->state = 0;
-			st->use_file = (int) getrand(thread, 0, num_files - 1);
+			st->use_file = chooseScript(thread);
 			commands = sql_files[st->use_file];
 			st->is_throttled = false;
 
@@ -1383,8 +1557,12 @@ top:
 		goto top;
 	}
 
-	/* Record transaction start time under logging, progress or throttling */
-	if ((logfile || progress || throttle_delay || latency_limit) && st->state == 0)
+	/*
+	 * Record transaction start time under logging, progress, throttling or
+	 * latency reporting
+	 */
+	if ((logfile || progress || throttle_delay || latency_limit ||
+		 is_latencies) && st->state == 0)
 	{
 		INSTR_TIME_SET_CURRENT(st->txn_begin);
 
@@ -1396,6 +1574,16 @@ top:
 			st->txn_scheduled = INSTR_TIME_GET_MICROSEC(st->txn_begin);
 	}
 
+	/*
+	 * A command that went out as part of a pipeline only has its result to
+	 * wait for; its latency counts from when the pipeline was sent.
+	 */
+	if (st->state < st->pipeline_next)
+	{
+		st->listen = 1;
+		return true;
+	}
+
 	/* Record statement start time if per-command latencies are requested */
 	if (is_latencies)
 		INSTR_TIME_SET_CURRENT(st->stmt_begin);
@@ -1405,75 +1593,45 @@ top:
 		const Command *command = commands[st->state];
 		int			r;
 
-		if (querymode == QUERY_SIMPLE)
-		{
-			char	   *sql;
-
-			sql = pg_strdup(command->argv[0]);
-			sql = assignVariables(st, sql);
+		if (querymode == QUERY_PREPARED)
+			prepareScript(st, commands);
 
-			if (debug)
-				fprintf(stderr, "client %d sending %s\n", st->id, sql);
-			r = PQsendQuery(st->con, sql);
-			free(sql);
-		}
-		else if (querymode == QUERY_EXTENDED)
-		{
-			const char *sql = command->argv[0];
-			const char *params[MAX_ARGS];
-
-			getQueryParams(st, command, params);
-
-			if (debug)
-				fprintf(stderr, "client %d sending %s\n", st->id, sql);
-			r = PQsendQueryParams(st->con, sql, command->argc - 1,
-								  NULL, params, NULL, NULL, 0);
-		}
-		else if (querymode == QUERY_PREPARED)
+		if (use_pipeline)
 		{
-			char		name[MAX_PREPARE_NAME];
-			const char *params[MAX_ARGS];
+			int			j;
 
-			if (!st->prepared[st->use_file])
+			/*
+			 * Send this command and all SQL commands directly following it
+			 * in one go, and collect their results one by one afterwards.
+			 */
+			r = PQenterPipelineMode(st->con);
+			for (j = st->state;
+				 r && commands[j] != NULL && commands[j]->type == SQL_COMMAND;
+				 j++)
+				r = sendCommand(st, commands[j], j);
+			if (r)
+				r = PQpipelineSync(st->con);
+			if (r == 0)
 			{
-				int			j;
-
-				for (j = 0; commands[j] != NULL; j++)
-				{
-					PGresult   *res;
-					char		name[MAX_PREPARE_NAME];
-
-					if (commands[j]->type != SQL_COMMAND)
-						continue;
-					preparedStatementName(name, st->use_file, j);
-					res = PQprepare(st->con, name,
-						  commands[j]->argv[0], commands[j]->argc - 1, NULL);
-					if (PQresultStatus(res) != PGRES_COMMAND_OK)
-						fprintf(stderr, "%s", PQerrorMessage(st->con));
-					PQclear(res);
-				}
-				st->prepared[st->use_file] = true;
+				fprintf(stderr, "Client %d aborted in state %d: %s",
+						st->id, st->state, PQerrorMessage(st->con));
+				return clientDone(st, false);
 			}
-
-			getQueryParams(st, command, params);
-			preparedStatementName(name, st->use_file, st->state);
-
-			if (debug)
-				fprintf(stderr, "client %d sending %s\n", st->id, name);
-			r = PQsendQueryPrepared(st->con, name, command->argc - 1,
-									params, NULL, NULL, 0);
+			st->pipeline_next = j;
+			st->listen = 1;
 		}
-		else	/* unknown sql mode */
-			r = 0;
-
-		if (r == 0)
+		else
 		{
-			if (debug)
-				fprintf(stderr, "client %d cannot send %s\n", st->id, command->argv[0]);
-			st->ecnt++;
+			r = sendCommand(st, command, st->state);
+			if (r == 0)
+			{
+				if (debug)
+					fprintf(stderr, "client %d cannot send %s\n", st->id, command->argv[0]);
+				st->ecnt++;
+			}
+			else
+				st->listen = 1;		/* flags that should be listened */
 		}
-		else
-			st->listen = 1;		/* flags that should be listened */
 	}
 	else if (commands[st->state]->type == META_COMMAND)
 	{
@@ -2492,7 +2650,7 @@ read_line_from_file(FILE *fd)
 	return NULL;
 }
 
-static int
+static Command **
 process_file(char *filename)
 {
 #define COMMANDS_ALLOC_NUM 128
@@ -2504,12 +2662,6 @@ process_file(char *filename)
 	char	   *buf;
 	int			alloc_num;
 
-	if (num_files >= MAX_FILES)
-	{
-		fprintf(stderr, "Up to only %d SQL files are allowed\n", MAX_FILES);
-		exit(1);
-	}
-
 	alloc_num = COMMANDS_ALLOC_NUM;
 	my_commands = (Command **) pg_malloc(sizeof(Command *) * alloc_num);
 
@@ -2519,7 +2671,7 @@ process_file(char *filename)
 	{
 		fprintf(stderr, "%s: %s\n", filename, strerror(errno));
 		pg_free(my_commands);
-		return false;
+		return NULL;
 	}
 
 	lineno = 0;
@@ -2551,9 +2703,7 @@ process_file(char *filename)
 
 	my_commands[index] = NULL;
 
-	sql_files[num_files++] = my_commands;
-
-	return true;
+	return my_commands;
 }
 
 static Command **
@@ -2611,9 +2761,235 @@ process_builtin(char *tb, const char *source)
 	return my_commands;
 }
 
+/*
+ * Split a -b or -f argument of the form NAME[@WEIGHT] into its name, which
+ * is returned, and its weight, which defaults to 1.
+ */
+static char *
+parseScriptWeight(const char *option, int *weight)
+{
+	char	   *name = pg_strdup(option);
+	char	   *sep;
+
+	*weight = 1;
+	if ((sep = strrchr(name, '@')) != NULL)
+	{
+		char	   *badp;
+		long		wtmp;
+
+		*sep++ = '\0';
+		errno = 0;
+		wtmp = strtol(sep, &badp, 10);
+		if (errno != 0 || badp == sep || *badp != '\0' ||
+			wtmp < 0 || wtmp > INT_MAX)
+		{
+			fprintf(stderr, "invalid weight specification: %s\n", option);
+			exit(1);
+		}
+		*weight = (int) wtmp;
+	}
+	return name;
+}
+
+/*
+ * Find a built-in script by name, or unambiguous prefix of its name.
+ * "list" shows the available scripts and exits.
+ */
+static const BuiltinScript *
+findBuiltin(const char *name)
+{
+	const BuiltinScript *result = NULL;
+	int			nmatch = 0;
+	int			i;
+
+	for (i = 0; i < lengthof(builtin_script); i++)
+	{
+		if (strcmp(name, builtin_script[i].name) == 0)
+			return &builtin_script[i];
+		if (strncmp(name, builtin_script[i].name, strlen(name)) == 0)
+		{
+			result = &builtin_script[i];
+			nmatch++;
+		}
+	}
+	if (nmatch == 1)
+		return result;
+
+	if (strcmp(name, "list") != 0)
+		fprintf(stderr, "%s builtin script \"%s\"\n",
+				nmatch > 1 ? "ambiguous" : "no", name);
+	fprintf(stderr, "Available builtin scripts:\n");
+	for (i = 0; i < lengthof(builtin_script); i++)
+		fprintf(stderr, "\t%s\n", builtin_script[i].name);
+	exit(strcmp(name, "list") == 0 ? 0 : 1);
+}
+
+/*
+ * Add a parsed script to the set the clients choose from.
+ */
+static void
+addScript(Command **commands, const char *name, const char *type,
+		  int weight)
+{
+	if (commands[0] == NULL)
+	{
+		fprintf(stderr, "script \"%s\" does not contain any command\n",
+				name);
+		exit(1);
+	}
+	if (num_files >= MAX_FILES)
+	{
+		fprintf(stderr, "Up to only %d SQL files are allowed\n", MAX_FILES);
+		exit(1);
+	}
+	sql_files[num_files] = commands;
+	sql_file_names[num_files] = name;
+	sql_file_types[num_files] = type;
+	sql_file_weights[num_files] = weight;
+	total_weight += weight;
+	num_files++;
+}
+
+/*
+ * Choose the script for a client's next transaction, at random according
+ * to the weights.
+ */
+static int
+chooseScript(TState *thread)
+{
+	int			i = 0;
+	int64		w;
+
+	if (num_files == 1)
+		return 0;
+
+	w = getrand(thread, 0, total_weight - 1);
+	do
+	{
+		w -= sql_file_weights[i++];
+	} while (w >= 0);
+
+	return i - 1;
+}
+
+/*
+ * Map a latency in microseconds to its histogram bucket.
+ */
+static int
+hist_bucket(int64 value)
+{
+	int			msb = 0;
+	int			shift;
+
+	if (value < 0)
+		return 0;
+	if (value < LATENCY_HIST_SUB)
+		return (int) value;
+	if (value >= INT64CONST(1) << LATENCY_HIST_MAX_BITS)
+		return LATENCY_HIST_BUCKETS - 1;
+
+	/* find the highest set bit */
+	while ((value >> msb) > 1)
+		msb++;
+	shift = msb - LATENCY_HIST_SUB_BITS;
+
+	/* value >> shift is in [LATENCY_HIST_SUB, 2 * LATENCY_HIST_SUB) */
+	return LATENCY_HIST_SUB * (shift + 1) +
+		(int) ((value >> shift) - LATENCY_HIST_SUB);
+}
+
+/*
+ * The largest latency that falls into this histogram bucket.
+ */
+static int64
+hist_bucket_value(int bucket)
+{
+	int			shift = bucket / LATENCY_HIST_SUB - 1;
+	int64		sub = bucket % LATENCY_HIST_SUB + LATENCY_HIST_SUB;
+
+	if (shift <= 0)
+		return bucket;
+	return ((sub + 1) << shift) - 1;
+}
+
+static void
+hist_record(LatencyHist *hist, int64 value)
+{
+	hist->buckets[hist_bucket(value)]++;
+	hist->count++;
+	if (value > hist->max)
+		hist->max = value;
+}
+
+static void
+hist_merge(LatencyHist *dst, const LatencyHist *src)
+{
+	int			i;
+
+	for (i = 0; i < LATENCY_HIST_BUCKETS; i++)
+		dst->buckets[i] += src->buckets[i];
+	dst->count += src->count;
+	if (src->max > dst->max)
+		dst->max = src->max;
+}
+
+/*
+ * Compute the histogram of the values recorded in cur since it was last
+ * saved in last, and save cur in last for next time.  The maximum of the
+ * interval is only known to be at most that of cur.
+ */
+static void
+hist_interval(LatencyHist *interval, const LatencyHist *cur,
+			  LatencyHist *last)
+{
+	int			i;
+
+	for (i = 0; i < LATENCY_HIST_BUCKETS; i++)
+		interval->buckets[i] = cur->buckets[i] - last->buckets[i];
+	interval->count = cur->count - last->count;
+	interval->max = cur->max;
+	*last = *cur;
+}
+
+/*
+ * Return the latency below or at which pct percent of the values fall,
+ * rounded up to the end of its bucket.
+ */
+static int64
+hist_percentile(const LatencyHist *hist, double pct)
+{
+	int64		rank = (int64) ceil(pct / 100.0 * hist->count);
+	int64		seen = 0;
+	int			i;
+
+	if (rank < 1)
+		rank = 1;
+	for (i = 0; i < LATENCY_HIST_BUCKETS; i++)
+	{
+		seen += hist->buckets[i];
+		if (seen >= rank)
+			return Min(hist_bucket_value(i), hist->max);
+	}
+	return hist->max;
+}
+
+/*
+ * Print the standard set of percentiles of a histogram, in milliseconds.
+ */
+static void
+print_hist_percentiles(FILE *out, const LatencyHist *hist)
+{
+	fprintf(out, "p50 %.3f p90 %.3f p99 %.3f p99.9 %.3f max %.3f",
+			0.001 * hist_percentile(hist, 50.0),
+			0.001 * hist_percentile(hist, 90.0),
+			0.001 * hist_percentile(hist, 99.0),
+			0.001 * hist_percentile(hist, 99.9),
+			0.001 * hist_percentile(hist, 100.0));
+}
+
 /* print out results */
 static void
-printResults(int ttype, int64 normal_xacts, int nclients,
+printResults(int64 normal_xacts, int nclients,
 			 TState *threads, int nthreads,
 			 instr_time total_time, instr_time conn_total_time,
 			 int64 total_latencies, int64 total_sqlats,
@@ -2623,23 +2999,22 @@ printResults(int ttype, int64 normal_xacts, int nclients,
 	double		time_include,
 				tps_include,
 				tps_exclude;
-	char	   *s;
+	int			i;
 
 	time_include = INSTR_TIME_GET_DOUBLE(total_time);
 	tps_include = normal_xacts / time_include;
 	tps_exclude = normal_xacts / (time_include -
 						(INSTR_TIME_GET_DOUBLE(conn_total_time) / nthreads));
 
-	if (ttype == 0)
-		s = "TPC-B (sort of)";
-	else if (ttype == 2)
-		s = "Update only pgbench_accounts";
-	else if (ttype == 1)
-		s = "SELECT only";
+	if (num_files == 1)
+		printf("transaction type: %s\n", sql_file_types[0]);
 	else
-		s = "Custom query";
-
-	printf("transaction type: %s\n", s);
+	{
+		printf("transaction type: multiple scripts\n");
+		for (i = 0; i < num_files; i++)
+			printf("SQL script %d: %s\n - weight = %d\n",
+				   i + 1, sql_file_names[i], sql_file_weights[i]);
+	}
 	printf("scaling factor: %d\n", scale);
 	printf("query mode: %s\n", QUERYMODE[querymode]);
 	printf("number of clients: %d\n", nclients);
@@ -2671,7 +3046,7 @@ printResults(int ttype, int64 normal_xacts, int nclients,
 			   latency_limit / 1000.0, latency_late,
 		   100.0 * latency_late / (throttle_latency_skipped + normal_xacts));
 
-	if (throttle_delay || progress || latency_limit)
+	if (throttle_delay || progress || latency_limit || is_latencies)
 	{
 		/* compute and show latency average and standard deviation */
 		double		latency = 0.001 * total_latencies / normal_xacts;
@@ -2680,6 +3055,20 @@ printResults(int ttype, int64 normal_xacts, int nclients,
 		printf("latency average: %.3f ms\n"
 			   "latency stddev: %.3f ms\n",
 			   latency, 0.001 * sqrt(sqlat - 1000000.0 * latency * latency));
+
+		/* and percentiles, from the merged per-thread histograms */
+		if (use_latency_hist)
+		{
+			LatencyHist *hist = pg_malloc0(sizeof(LatencyHist));
+			int			t;
+
+			for (t = 0; t < nthreads; t++)
+				hist_merge(hist, threads[t].latency_hist);
+			printf("latency percentiles (ms): ");
+			print_hist_percentiles(stdout, hist);
+			printf("\n");
+			free(hist);
+		}
 	}
 	else
 	{
@@ -2706,8 +3095,6 @@ printResults(int ttype, int64 normal_xacts, int nclients,
 	/* Report per-command latencies */
 	if (is_latencies)
 	{
-		int			i;
-
 		for (i = 0; i < num_files; i++)
 		{
 			Command   **commands;
@@ -2746,6 +3133,47 @@ printResults(int ttype, int64 normal_xacts, int nclients,
 				printf("\t%f\t%s\n", total_time, command->line);
 			}
 		}
+
+		/* Report per-script and per-command latency percentiles */
+		if (use_latency_hist)
+		{
+			LatencyHist *hist = pg_malloc(sizeof(LatencyHist));
+
+			for (i = 0; i < num_files; i++)
+			{
+				Command   **commands;
+				int			t;
+
+				if (num_files > 1)
+				{
+					memset(hist, 0, sizeof(LatencyHist));
+					for (t = 0; t < nthreads; t++)
+						hist_merge(hist, &threads[t].file_hist[i]);
+					printf("latency percentiles in milliseconds, file %d: ",
+						   i + 1);
+					print_hist_percentiles(stdout, hist);
+					printf("\n");
+					printf("statement latency percentiles in milliseconds, file %d:\n",
+						   i + 1);
+				}
+				else
+					printf("statement latency percentiles in milliseconds:\n");
+
+				for (commands = sql_files[i]; *commands != NULL; commands++)
+				{
+					Command    *command = *commands;
+
+					memset(hist, 0, sizeof(LatencyHist));
+					for (t = 0; t < nthreads; t++)
+						hist_merge(hist,
+								   &threads[t].exec_hist[command->command_num]);
+					printf("\t");
+					print_hist_percentiles(stdout, hist);
+					printf("\t%s\n", command->line);
+				}
+			}
+			free(hist);
+		}
 	}
 }
 
@@ -2759,6 +3187,7 @@ main(int argc, char **argv)
 		{"connect", no_argument, NULL, 'C'},
 		{"debug", no_argument, NULL, 'd'},
 		{"define", required_argument, NULL, 'D'},
+		{"builtin", required_argument, NULL, 'b'},
 		{"file", required_argument, NULL, 'f'},
 		{"fillfactor", required_argument, NULL, 'F'},
 		{"host", required_argument, NULL, 'h'},
@@ -2785,6 +3214,7 @@ main(int argc, char **argv)
 		{"unlogged-tables", no_argument, &unlogged_tables, 1},
 		{"sampling-rate", required_argument, NULL, 4},
 		{"aggregate-interval", required_argument, NULL, 5},
+		{"pipeline", no_argument, NULL, 6},
 		{"rate", required_argument, NULL, 'R'},
 		{"latency-limit", required_argument, NULL, 'L'},
 		{NULL, 0, NULL, 0}
@@ -2796,10 +3226,11 @@ main(int argc, char **argv)
 	int			is_init_mode = 0;		/* initialize mode? */
 	int			is_no_vacuum = 0;		/* no vacuum at all before testing? */
 	int			do_vacuum_accounts = 0; /* do vacuum accounts before testing? */
-	int			ttype = 0;		/* transaction type. 0: TPC-B, 1: SELECT only,
-								 * 2: skip update of branches and tellers */
 	int			optindex;
-	char	   *filename = NULL;
+	char	   *script_args[MAX_FILES];	/* -b and -f arguments, in order */
+	bool		script_is_builtin[MAX_FILES];
+	int			num_script_args = 0;
+	bool		builtin_used = false;
 	bool		scale_given = false;
 
 	bool		benchmarking_option_set = false;
@@ -2862,7 +3293,7 @@ main(int argc, char **argv)
 	state = (CState *) pg_malloc(sizeof(CState));
 	memset(state, 0, sizeof(CState));
 
-	while ((c = getopt_long(argc, argv, "ih:nvp:dqSNc:j:Crs:t:T:U:lf:D:F:M:P:R:L:", long_options, &optindex)) != -1)
+	while ((c = getopt_long(argc, argv, "ih:nvp:dqb:SNc:j:Crs:t:T:U:lf:D:F:M:P:R:L:", long_options, &optindex)) != -1)
 	{
 		switch (c)
 		{
@@ -2884,13 +3315,22 @@ main(int argc, char **argv)
 			case 'd':
 				debug++;
 				break;
+			case 'b':
+			case 'f':
 			case 'S':
-				ttype = 1;
-				benchmarking_option_set = true;
-				break;
 			case 'N':
-				ttype = 2;
+				/* scripts are parsed below, once -M is known */
 				benchmarking_option_set = true;
+				if (num_script_args >= MAX_FILES)
+				{
+					fprintf(stderr, "Up to only %d SQL files are allowed\n",
+							MAX_FILES);
+					exit(1);
+				}
+				script_is_builtin[num_script_args] = (c != 'f');
+				script_args[num_script_args++] =
+					c == 'S' ? "select-only" :
+					c == 'N' ? "simple-update" : optarg;
 				break;
 			case 'c':
 				benchmarking_option_set = true;
@@ -2983,13 +3423,6 @@ main(int argc, char **argv)
 				initialization_option_set = true;
 				use_quiet = true;
 				break;
-			case 'f':
-				benchmarking_option_set = true;
-				ttype = 3;
-				filename = pg_strdup(optarg);
-				if (process_file(filename) == false || *sql_files[num_files - 1] == NULL)
-					exit(1);
-				break;
 			case 'D':
 				{
 					char	   *p;
@@ -3018,11 +3451,6 @@ main(int argc, char **argv)
 				break;
 			case 'M':
 				benchmarking_option_set = true;
-				if (num_files > 0)
-				{
-					fprintf(stderr, "query mode (-M) should be specified before transaction scripts (-f)\n");
-					exit(1);
-				}
 				for (querymode = 0; querymode < NUM_QUERYMODE; querymode++)
 					if (strcmp(optarg, QUERYMODE[querymode]) == 0)
 						break;
@@ -3108,6 +3536,10 @@ main(int argc, char **argv)
 				}
 #endif
 				break;
+			case 6:
+				benchmarking_option_set = true;
+				use_pipeline = true;
+				break;
 			default:
 				fprintf(stderr, _("Try \"%s --help\" for more information.\n"), progname);
 				exit(1);
@@ -3115,6 +3547,48 @@ main(int argc, char **argv)
 		}
 	}
 
+	/* the default scenario is the TPC-B like builtin script */
+	if (num_script_args == 0)
+	{
+		script_is_builtin[0] = true;
+		script_args[num_script_args++] = "tpcb-like";
+	}
+
+	/* parse the transaction scripts, in the order given */
+	for (i = 0; i < num_script_args; i++)
+	{
+		int			weight;
+		char	   *name = parseScriptWeight(script_args[i], &weight);
+
+		if (script_is_builtin[i])
+		{
+			const BuiltinScript *bi = findBuiltin(name);
+
+			addScript(process_builtin(*bi->script, bi->source),
+					  bi->source, bi->type, weight);
+			builtin_used = true;
+		}
+		else
+		{
+			Command   **commands = process_file(name);
+
+			if (commands == NULL)
+				exit(1);
+			addScript(commands, name, "Custom query", weight);
+		}
+	}
+	if (total_weight == 0)
+	{
+		fprintf(stderr, "total script weight must not be zero\n");
+		exit(1);
+	}
+
+	if (use_pipeline && querymode == QUERY_SIMPLE)
+	{
+		fprintf(stderr, "--pipeline requires extended or prepared query mode (-M)\n");
+		exit(1);
+	}
+
 	/* compute a per thread delay */
 	throttle_delay *= nthreads;
 
@@ -3206,6 +3680,10 @@ main(int argc, char **argv)
 		fprintf(stderr, "-r does not work with -j larger than 1 on this platform.\n");
 		exit(1);
 	}
+
+	/* latency histograms have the same limitation; just omit percentiles */
+	if (nthreads > 1)
+		use_latency_hist = false;
 #endif
 
 	/*
@@ -3257,11 +3735,11 @@ main(int argc, char **argv)
 		exit(1);
 	}
 
-	if (ttype != 3)
+	if (builtin_used)
 	{
 		/*
 		 * get the scaling factor that should be same as count(*) from
-		 * pgbench_branches if this is not a custom query
+		 * pgbench_branches if a builtin script is used
 		 */
 		res = PQexec(con, "select count(*) from pgbench_branches");
 		if (PQresultStatus(res) != PGRES_TUPLES_OK)
@@ -3333,31 +3811,6 @@ main(int argc, char **argv)
 	INSTR_TIME_SET_CURRENT(start_time);
 	srandom((unsigned int) INSTR_TIME_GET_MICROSEC(start_time));
 
-	/* process builtin SQL scripts */
-	switch (ttype)
-	{
-		case 0:
-			sql_files[0] = process_builtin(tpc_b,
-										   "<builtin: TPC-B (sort of)>");
-			num_files = 1;
-			break;
-
-		case 1:
-			sql_files[0] = process_builtin(select_only,
-										   "<builtin: select only>");
-			num_files = 1;
-			break;
-
-		case 2:
-			sql_files[0] = process_builtin(simple_update,
-										   "<builtin: simple update>");
-			num_files = 1;
-			break;
-
-		default:
-			break;
-	}
-
 	/* set up thread data structures */
 	threads = (TState *) pg_malloc(sizeof(TState) * nthreads);
 	for (i = 0; i < nthreads; i++)
@@ -3394,7 +3847,24 @@ main(int argc, char **argv)
 			thread->exec_elapsed = NULL;
 			thread->exec_count = NULL;
 		}
+
+		/* Histograms for latency percentiles, whenever latency is measured */
+		thread->exec_hist = NULL;
+		thread->latency_hist = NULL;
+		thread->file_hist = NULL;
+		if (progress || throttle_delay || latency_limit || is_latencies)
+		{
+			thread->latency_hist = (LatencyHist *)
+				pg_malloc0(sizeof(LatencyHist));
+			thread->file_hist = (LatencyHist *)
+				pg_malloc0(sizeof(LatencyHist) * num_files);
+			if (is_latencies)
+				thread->exec_hist = (LatencyHist *)
+					pg_malloc0(sizeof(LatencyHist) * num_commands);
+		}
 	}
+	if (!threads[0].latency_hist)
+		use_latency_hist = false;
 
 	/* get start up time */
 	INSTR_TIME_SET_CURRENT(start_time);
@@ -3468,7 +3938,7 @@ main(int argc, char **argv)
 	 */
 	INSTR_TIME_SET_CURRENT(total_time);
 	INSTR_TIME_SUBTRACT(total_time, start_time);
-	printResults(ttype, total_xacts, nclients, threads, nthreads,
+	printResults(total_xacts, nclients, threads, nthreads,
 				 total_time, conn_total_time, total_latencies, total_sqlats,
 				 throttle_lag, throttle_lag_max, throttle_latency_skipped,
 				 latency_late);
@@ -3498,6 +3968,9 @@ threadRun(void *arg)
 				last_sqlats = 0,
 				last_lags = 0,
 				last_skipped = 0;
+	LatencyHist *cur_hist = NULL,	/* for progress percentiles */
+			   *last_hist = NULL,
+			   *interval_hist = NULL;
 
 	AggVals		aggs;
 
@@ -3514,6 +3987,13 @@ threadRun(void *arg)
 
 	result = pg_malloc(sizeof(TResult));
 
+	if (progress && thread->latency_hist)
+	{
+		cur_hist = (LatencyHist *) pg_malloc0(sizeof(LatencyHist));
+		last_hist = (LatencyHist *) pg_malloc0(sizeof(LatencyHist));
+		interval_hist = (LatencyHist *) pg_malloc0(sizeof(LatencyHist));
+	}
+
 	INSTR_TIME_SET_ZERO(result->conn_time);
 
 	/* open log file if requested */
@@ -3557,7 +4037,7 @@ threadRun(void *arg)
 		Command   **commands = sql_files[st->use_file];
 		int			prev_ecnt = st->ecnt;
 
-		st->use_file = getrand(thread, 0, num_files - 1);
+		st->use_file = chooseScript(thread);
 		if (!doCustom(thread, st, &result->conn_time, logfile, &aggs))
 			remains--;			/* I've aborted */
 
@@ -3730,6 +4210,16 @@ threadRun(void *arg)
 						"progress %d: %.1f s, %.1f tps, "
 						"lat %.3f ms stddev %.3f",
 						thread->tid, total_run, tps, latency, stdev);
+				if (cur_hist)
+				{
+					hist_interval(interval_hist, thread->latency_hist,
+								  last_hist);
+					if (interval_hist->count > 0)
+					{
+						fprintf(stderr, ", ");
+						print_hist_percentiles(stderr, interval_hist);
+					}
+				}
 				if (throttle_delay)
 				{
 					fprintf(stderr, ", lag %.3f ms", lag);
@@ -3794,6 +4284,19 @@ threadRun(void *arg)
 						"progress: %.1f s, %.1f tps, "
 						"lat %.3f ms stddev %.3f",
 						total_run, tps, latency, stdev);
+				if (cur_hist)
+				{
+					/* unlocked reads, like the counters above */
+					memset(cur_hist, 0, sizeof(LatencyHist));
+					for (i = 0; i < progress_nthreads; i++)
+						hist_merge(cur_hist, thread[i].latency_hist);
+					hist_interval(interval_hist, cur_hist, last_hist);
+					if (interval_hist->count > 0)
+					{
+						fprintf(stderr, ", ");
+						print_hist_percentiles(stderr, interval_hist);
+					}
+				}
 				if (throttle_delay)
 				{
 					fprintf(stderr, ", lag %.3f ms", lag);
@@ -3835,6 +4338,12 @@ done:
 	INSTR_TIME_ACCUM_DIFF(result->conn_time, end, start);
 	if (logfile)
 		fclose(logfile);
+	if (cur_hist)
+	{
+		free(cur_hist);
+		free(last_hist);
+		free(interval_hist);
+	}
 	return result;
 }
 
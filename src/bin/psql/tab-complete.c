@@ -1691,7 +1691,7 @@ psql_completion(const char *text, int start, int end)
 			 pg_strcasecmp(prev_wd, "SET") == 0)
 	{
 		static const char *const list_COLUMNSET[] =
-		{"(", "DEFAULT", "NOT NULL", "STATISTICS", "STORAGE", NULL};
+		{"(", "COMPRESSION", "DEFAULT", "NOT NULL", "STATISTICS", "STORAGE", NULL};
 
 		COMPLETE_WITH_LIST(list_COLUMNSET);
 	}
@@ -1703,7 +1703,7 @@ psql_completion(const char *text, int start, int end)
 			 pg_strcasecmp(prev_wd, "(") == 0)
 	{
 		static const char *const list_COLUMNOPTIONS[] =
-		{"n_distinct", "n_distinct_inherited", NULL};
+		{"compression", "n_distinct", "n_distinct_inherited", NULL};
 
 		COMPLETE_WITH_LIST(list_COLUMNOPTIONS);
 	}
@@ -29,7 +29,7 @@
  *
  *			int32
  *			pglz_decompress(const char *source, int32 slen, char *dest,
- *							int32 rawsize)
+ *							int32 rawsize, bool check_complete)
  *
  *				source is the compressed input.
  *
@@ -42,11 +42,27 @@
  *					The data is written to buff exactly as it was handed
  *					to pglz_compress(). No terminating zero byte is added.
  *
- *				rawsize is the length of the uncompressed data.
+ *				rawsize is the length of the uncompressed data, or of
+ *					the prefix of it the caller wants.
+ *
+ *				check_complete says whether source must decompress to
+ *					exactly rawsize bytes.  If false, decompression stops
+ *					once rawsize bytes have been produced, or when the input
+ *					runs out, so a prefix of the data can be recovered from
+ *					a prefix of the compressed input.
  *
  *				The return value is the number of bytes written in the
  *				buffer dest, or -1 if decompression fails.
  *
+ *			int32
+ *			pglz_maximum_compressed_size(int32 rawsize,
+ *										 int32 total_compressed_size)
+ *
+ *				Returns how many bytes of compressed input can be needed
+ *				to decompress the first rawsize bytes of the data, given
+ *				that the whole compressed input is total_compressed_size
+ *				bytes long.
+ *
  *		The decompression algorithm and internal data format:
  *
  *			It is made with the compressed data itself.
@@ -675,12 +691,14 @@ pglz_compress(const char *source, int32 slen, char *dest,
  *
  *		Decompresses source into dest. Returns the number of bytes
  *		decompressed in the destination buffer, or -1 if decompression
- *		fails.
+ *		fails.  Unless check_complete is true, it's not an error for the
+ *		input to hold more data than fits in rawsize bytes, nor for it to
+ *		end early.
  * ----------
  */
 int32
 pglz_decompress(const char *source, int32 slen, char *dest,
-				int32 rawsize)
+				int32 rawsize, bool check_complete)
 {
 	const unsigned char *sp;
 	const unsigned char *srcend;
@@ -722,16 +740,23 @@ pglz_decompress(const char *source, int32 slen, char *dest,
 					len += *sp++;
 
 				/*
-				 * Check for output buffer overrun, to ensure we don't clobber
-				 * memory in case of corrupt input.  Note: we must advance dp
-				 * here to ensure the error is detected below the loop.  We
-				 * don't simply put the elog inside the loop since that will
-				 * probably interfere with optimization.
+				 * Check for corrupt input: the tag mustn't run past the end
+				 * of the input, and the offset must point into the output
+				 * produced so far.
+				 */
+				if (sp > srcend || off == 0 || off > dp - (unsigned char *) dest)
+					return -1;
+
+				/*
+				 * A match running past the end of the output is an error if
+				 * we were asked for the complete data, and otherwise just
+				 * means that the prefix we wanted ends inside it.
 				 */
 				if (dp + len > destend)
 				{
-					dp += len;
-					break;
+					if (check_complete)
+						return -1;
+					len = destend - dp;
 				}
 
 				/*
@@ -753,7 +778,11 @@ pglz_decompress(const char *source, int32 slen, char *dest,
 				 * one from INPUT to OUTPUT.
 				 */
 				if (dp >= destend)		/* check for buffer overrun */
+				{
+					if (check_complete)
+						return -1;
 					break;		/* do not clobber memory */
+				}
 
 				*dp++ = *sp++;
 			}
@@ -768,11 +797,31 @@ pglz_decompress(const char *source, int32 slen, char *dest,
 	/*
 	 * Check we decompressed the right amount.
 	 */
-	if (dp != destend || sp != srcend)
+	if (check_complete && (dp != destend || sp != srcend))
 		return -1;
 
 	/*
 	 * That's it.
 	 */
-	return rawsize;
+	return (char *) dp - dest;
+}
+
+
+/* ----------
+ * pglz_maximum_compressed_size -
+ *
+ *		Calculates how much of the compressed data is needed to decompress
+ *		the first rawsize bytes of the data.  In the worst case, every
+ *		output byte is a literal, costing one byte plus one control bit,
+ *		and the last item may be a tag of up to 3 bytes.
+ * ----------
+ */
+int32
+pglz_maximum_compressed_size(int32 rawsize, int32 total_compressed_size)
+{
+	int64		compressed_size;
+
+	compressed_size = ((int64) rawsize * 9 + 7) / 8 + 2;
+
+	return (int32) Min(compressed_size, total_compressed_size);
 }
@@ -82,6 +82,7 @@ typedef bool (*IndexBulkDeleteCallback) (ItemPointer itemptr, void *state);
 /* struct definitions appear in relscan.h */
 typedef struct IndexScanDescData *IndexScanDesc;
 typedef struct SysScanDescData *SysScanDesc;
+typedef struct ParallelIndexScanDescData *ParallelIndexScanDesc;
 
 /*
  * Enumeration specifying the type of uniqueness check to perform in
@@ -144,6 +145,17 @@ extern void index_rescan(IndexScanDesc scan,
 extern void index_endscan(IndexScanDesc scan);
 extern void index_markpos(IndexScanDesc scan);
 extern void index_restrpos(IndexScanDesc scan);
+extern Size index_parallelscan_estimate(Relation indexRelation,
+							int nparticipants);
+extern void index_parallelscan_initialize(Relation heapRelation,
+							  Relation indexRelation,
+							  ParallelIndexScanDesc target,
+							  int nparticipants);
+extern IndexScanDesc index_beginscan_parallel(Relation heapRelation,
+						 Relation indexRelation,
+						 int nkeys, int norderbys,
+						 Snapshot snapshot,
+						 ParallelIndexScanDesc pscan);
 extern ItemPointer index_getnext_tid(IndexScanDesc scan,
 				  ScanDirection direction);
 extern HeapTuple index_fetch_heap(IndexScanDesc scan);
@@ -937,6 +937,7 @@ extern void ginHeapTupleFastCollect(GinState *ginstate,
 						ItemPointer ht_ctid);
 extern void ginInsertCleanup(GinState *ginstate,
 				 bool vac_delay, IndexBulkDeleteResult *stats);
+extern Datum gin_clean_pending_list(PG_FUNCTION_ARGS);
 
 /* ginpostinglist.c */
 
@@ -72,6 +72,16 @@ typedef HashPageOpaqueData *HashPageOpaque;
  */
 #define HASHO_PAGE_ID		0xFF80
 
+/*
+ * While a bucket split is in progress (see hashm_splitstate below), items of
+ * the old bucket that have already been copied into the new bucket are
+ * marked with this bit in t_info.  The new copies are not marked.
+ */
+#define HASH_COPIED_BY_SPLIT	INDEX_AM_RESERVED_BIT
+
+#define HashTupleIsCopied(itup) \
+	(((itup)->t_info & HASH_COPIED_BY_SPLIT) != 0)
+
 /*
  *	HashScanOpaqueData is private state for a hash index scan.
  */
@@ -93,6 +103,15 @@ typedef struct HashScanOpaqueData
 	 */
 	BlockNumber hashso_bucket_blkno;
 
+	/*
+	 * We also keep the bucket's primary page pinned for as long as we hold
+	 * the bucket lock.  That makes no difference in normal running, but on a
+	 * hot standby WAL replay of anything that moves or removes tuples waits
+	 * for a cleanup lock on the primary bucket page, which is how a standby
+	 * scan is protected in place of the bucket lock.
+	 */
+	Buffer		hashso_bucket_buf;
+
 	/*
 	 * We also want to remember which buffer we're currently examining in the
 	 * scan. We keep the buffer pinned (but not locked) across hashgettuple
@@ -138,6 +157,16 @@ typedef HashScanOpaqueData *HashScanOpaque;
  * There is no particular upper limit on the size of mapp[], other than
  * needing to fit into the metapage.  (With 8K block size, 128 bitmaps
  * limit us to 64 Gb of overflow space...)
+ *
+ * hashm_splitstate tells whether the split that created bucket
+ * hashm_maxbucket is still in progress.  While it is HASH_SPLIT_COPYING,
+ * tuples belonging to the new bucket are being copied into it from the old
+ * bucket, and searches and insertions of such keys still go to the old
+ * bucket.  Once it is HASH_SPLIT_CLEANUP, the new bucket is complete but the
+ * old bucket still has to be purged of the copied tuples.  No other split
+ * can begin until the state is back to HASH_SPLIT_NONE.  The field was
+ * added after the rest, at the end so that existing metapages, where that
+ * space is zeroed, read as having no split in progress.
  */
 #define HASH_MAX_SPLITPOINTS		32
 #define HASH_MAX_BITMAPS			128
@@ -163,10 +192,16 @@ typedef struct HashMetaPageData
 	uint32		hashm_spares[HASH_MAX_SPLITPOINTS];		/* spare pages before
 														 * each splitpoint */
 	BlockNumber hashm_mapp[HASH_MAX_BITMAPS];	/* blknos of ovfl bitmaps */
+	uint32		hashm_splitstate;	/* state of last bucket's split */
 } HashMetaPageData;
 
 typedef HashMetaPageData *HashMetaPage;
 
+/* values of hashm_splitstate */
+#define HASH_SPLIT_NONE			0	/* no split in progress */
+#define HASH_SPLIT_COPYING		1	/* copying tuples to new bucket */
+#define HASH_SPLIT_CLEANUP		2	/* removing them from old bucket */
+
 /*
  * Maximum size of a hash index item (it's okay to have only one per page)
  */
@@ -227,6 +262,129 @@ typedef HashMetaPageData *HashMetaPage;
 #define HASH_SHARE		ShareLock
 #define HASH_EXCLUSIVE	ExclusiveLock
 
+/*
+ * XLOG records for hash operations
+ *
+ * XLOG allows to store some information in high 4 bits of log record xl_info
+ * field
+ */
+#define XLOG_HASH_INSERT		0x00	/* add index tuple to a bucket page */
+#define XLOG_HASH_ADD_OVFL_PAGE 0x10	/* add overflow page to a bucket */
+#define XLOG_HASH_FREE_OVFL_PAGE 0x20	/* remove empty overflow page */
+#define XLOG_HASH_SPLIT_ALLOCATE 0x30	/* add new bucket, begin split */
+#define XLOG_HASH_SPLIT_COPY	0x40	/* copy tuples into new bucket */
+#define XLOG_HASH_SPLIT_STATE	0x50	/* advance state of split */
+#define XLOG_HASH_MOVE_PAGE_CONTENTS 0x60	/* move tuples within a bucket */
+#define XLOG_HASH_DELETE		0x70	/* delete tuples from a page */
+#define XLOG_HASH_UPDATE_META_PAGE 0x80		/* set tuple count */
+
+/*
+ * This is what we need to know about a simple (without split) insert.
+ *
+ * Backup Blk 0: page the tuple was added to (tuple as data)
+ * Backup Blk 1: metapage, whose tuple count is incremented
+ */
+typedef struct xl_hash_insert
+{
+	OffsetNumber offnum;
+} xl_hash_insert;
+
+#define SizeOfHashInsert	(offsetof(xl_hash_insert, offnum) + sizeof(OffsetNumber))
+
+/*
+ * XLOG_HASH_ADD_OVFL_PAGE, XLOG_HASH_FREE_OVFL_PAGE and
+ * XLOG_HASH_SPLIT_ALLOCATE change several pages at once but rarely, so they
+ * carry full images of all the pages they change and no data of their own.
+ *
+ * Adding an overflow page logs the new overflow page (blk 0), the old tail
+ * of the bucket chain (1), the bitmap page the page came from (2) or the
+ * bitmap page created along with it (3), and the metapage (4).
+ *
+ * Freeing one logs the primary bucket page (blk 0, without image unless it
+ * is the freed page's predecessor), the freed page (1), its predecessor
+ * and successor when those are overflow pages (2 and 3), the bitmap page
+ * (4), and the metapage if hashm_firstfree changed (5).  Replay takes a
+ * cleanup lock on block 0, see HashScanOpaqueData.
+ *
+ * Beginning a split logs the new bucket's primary page (blk 0) and the
+ * metapage (1).
+ */
+
+/*
+ * Copy of tuples from an old bucket page into a page of the new bucket
+ * during a split.
+ *
+ * Backup Blk 0: old bucket page (offsets of the copied tuples as data)
+ * Backup Blk 1: new bucket page (the tuples as data)
+ */
+typedef struct xl_hash_split_copy
+{
+	uint16		ntups;
+} xl_hash_split_copy;
+
+#define SizeOfHashSplitCopy (offsetof(xl_hash_split_copy, ntups) + sizeof(uint16))
+
+/*
+ * Change of hashm_splitstate.
+ *
+ * Backup Blk 0: metapage
+ */
+typedef struct xl_hash_split_state
+{
+	uint32		splitstate;
+} xl_hash_split_state;
+
+#define SizeOfHashSplitState	(offsetof(xl_hash_split_state, splitstate) + sizeof(uint32))
+
+/*
+ * Move of tuples from a later page of a bucket to an earlier one, when the
+ * bucket is squeezed.
+ *
+ * Backup Blk 0: primary bucket page, unless it is the page written to
+ * Backup Blk 1: page written to (the tuples as data)
+ * Backup Blk 2: page read from (offsets of the moved tuples as data)
+ */
+typedef struct xl_hash_move_page_contents
+{
+	uint16		ntups;
+	bool		is_prim_bucket_same_wrt;	/* TRUE if the page written to
+											 * is the primary bucket page */
+} xl_hash_move_page_contents;
+
+#define SizeOfHashMovePageContents	\
+	(offsetof(xl_hash_move_page_contents, is_prim_bucket_same_wrt) + sizeof(bool))
+
+/*
+ * Removal of tuples from a bucket page, by VACUUM or when a split cleans up
+ * the old bucket.
+ *
+ * Backup Blk 0: primary bucket page
+ * Backup Blk 1: page tuples were deleted from, unless it is the primary
+ *
+ * The offsets of the deleted tuples are attached to whichever of the two
+ * blocks is the page they were on.
+ */
+typedef struct xl_hash_delete
+{
+	bool		is_primary_bucket_page; /* TRUE if the tuples were on the
+										 * primary bucket page */
+} xl_hash_delete;
+
+#define SizeOfHashDelete	(offsetof(xl_hash_delete, is_primary_bucket_page) + sizeof(bool))
+
+/*
+ * New tuple count, set by VACUUM.
+ *
+ * Backup Blk 0: metapage
+ */
+typedef struct xl_hash_update_meta_page
+{
+	double		ntuples;
+} xl_hash_update_meta_page;
+
+#define SizeOfHashUpdateMetaPage	\
+	(offsetof(xl_hash_update_meta_page, ntuples) + sizeof(double))
+
 /*
  *	Strategy number. There's only one valid strategy for hashing: equality.
  */
@@ -282,6 +440,15 @@ extern Datum hashvarlena(PG_FUNCTION_ARGS);
 extern Datum hash_any(register const unsigned char *k, register int keylen);
 extern Datum hash_uint32(uint32 k);
 
+/*
+ * Faster hash functions whose results may change between releases and
+ * platforms.  These must only be used for hash tables that are not stored
+ * on disk, such as dynahash tables and the executor's hash tables.
+ */
+extern Datum hashtext_fast(PG_FUNCTION_ARGS);
+extern Datum hashvarlena_fast(PG_FUNCTION_ARGS);
+extern Datum hash_any_fast(const unsigned char *k, int keylen);
+
 /* private routines */
 
 /* hashinsert.c */
@@ -291,10 +458,9 @@ extern OffsetNumber _hash_pgaddtup(Relation rel, Buffer buf,
 
 /* hashovfl.c */
 extern Buffer _hash_addovflpage(Relation rel, Buffer metabuf, Buffer buf);
-extern BlockNumber _hash_freeovflpage(Relation rel, Buffer ovflbuf,
-				   BufferAccessStrategy bstrategy);
-extern void _hash_initbitmap(Relation rel, HashMetaPage metap,
-				 BlockNumber blkno, ForkNumber forkNum);
+extern BlockNumber _hash_freeovflpage(Relation rel, Buffer bucketbuf,
+				   Buffer ovflbuf, BufferAccessStrategy bstrategy);
+extern void _hash_initbitmapbuffer(Buffer buf, uint16 bmsize);
 extern void _hash_squeezebucket(Relation rel,
 					Bucket bucket, BlockNumber bucket_blkno,
 					BufferAccessStrategy bstrategy);
@@ -313,13 +479,15 @@ extern Buffer _hash_getbuf_with_strategy(Relation rel, BlockNumber blkno,
 						   BufferAccessStrategy bstrategy);
 extern void _hash_relbuf(Relation rel, Buffer buf);
 extern void _hash_dropbuf(Relation rel, Buffer buf);
-extern void _hash_wrtbuf(Relation rel, Buffer buf);
 extern void _hash_chgbufaccess(Relation rel, Buffer buf, int from_access,
 				   int to_access);
 extern uint32 _hash_metapinit(Relation rel, double num_tuples,
 				ForkNumber forkNum);
 extern void _hash_pageinit(Page page, Size size);
 extern void _hash_expandtable(Relation rel, Buffer metabuf);
+extern bool _hash_split_step(Relation rel, Buffer metabuf);
+extern void _hash_delete_items(Relation rel, Buffer bucketbuf, Buffer buf,
+				   OffsetNumber *deletable, int ndeletable);
 
 /* hashscan.c */
 extern void _hash_regscan(IndexScanDesc scan);
@@ -347,6 +515,7 @@ extern uint32 _hash_datum2hashkey(Relation rel, Datum key);
 extern uint32 _hash_datum2hashkey_type(Relation rel, Datum key, Oid keytype);
 extern Bucket _hash_hashkey2bucket(uint32 hashkey, uint32 maxbucket,
 					 uint32 highmask, uint32 lowmask);
+extern Bucket _hash_getbucket(HashMetaPage metap, uint32 hashkey);
 extern uint32 _hash_log2(uint32 num);
 extern void _hash_checkpage(Relation rel, Buffer buf, int flags);
 extern uint32 _hash_get_indextuple_hashkey(IndexTuple itup);
@@ -355,8 +524,10 @@ extern IndexTuple _hash_form_tuple(Relation index,
 extern OffsetNumber _hash_binsearch(Page page, uint32 hash_value);
 extern OffsetNumber _hash_binsearch_last(Page page, uint32 hash_value);
 
-/* hash.c */
+/* hashxlog.c */
 extern void hash_redo(XLogReaderState *record);
+
+/* hashdesc.c */
 extern void hash_desc(StringInfo buf, XLogReaderState *record);
 extern const char *hash_identify(uint8 info);
 
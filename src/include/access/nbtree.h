@@ -47,6 +47,15 @@ typedef uint16 BTCycleId;
  *	(original) page, and set in the right page, but only if the next page
  *	to its right has a different cycleid.
  *
+ *	VACUUM only cares about the cycleid of leaf pages.  On internal pages the
+ *	field is instead a change counter, which lets _bt_search() read those
+ *	pages without a buffer lock: it is made odd before any multi-word change
+ *	to the page and even again afterwards, by _bt_page_change_begin() and
+ *	_bt_page_change_end(), and a reader that sees the same even value
+ *	before and after copying the page knows that its copy is consistent.
+ *	Changes that consist of a single aligned store, such as setting a flag
+ *	bit or a sibling link, need no bracketing.
+ *
  *	NOTE: the BTP_LEAF flag bit is redundant since level==0 could be tested
  *	instead.
  */
@@ -61,7 +70,8 @@ typedef struct BTPageOpaqueData
 		TransactionId xact;		/* next transaction ID, if deleted */
 	}			btpo;
 	uint16		btpo_flags;		/* flag bits, see below */
-	BTCycleId	btpo_cycleid;	/* vacuum cycle ID of latest split */
+	BTCycleId	btpo_cycleid;	/* vacuum cycle ID of latest split, or
+								 * change counter of internal page */
 } BTPageOpaqueData;
 
 typedef BTPageOpaqueData *BTPageOpaque;
@@ -121,6 +131,14 @@ typedef struct BTMetaPageData
 				   MAXALIGN(SizeOfPageHeaderData + 3*sizeof(ItemIdData)) - \
 				   MAXALIGN(sizeof(BTPageOpaqueData))) / 3)
 
+/*
+ * Posting list tuples are kept well below the maximum item size, so that a
+ * page holding one can still be split in a reasonable place, and so that
+ * VACUUM rewriting a single tuple doesn't rewrite half the page.
+ */
+#define BTMaxPostingSize(page) \
+	MAXALIGN_DOWN(BTMaxItemSize(page) / 2)
+
 /*
  * The leaf-page fillfactor defaults to 90% but is user-adjustable.
  * For pages above the leaf level, we use a fixed 70% fillfactor.
@@ -154,8 +172,10 @@ typedef struct BTMetaPageData
 	( (i1).ip_blkid.bi_hi == (i2).ip_blkid.bi_hi && \
 	  (i1).ip_blkid.bi_lo == (i2).ip_blkid.bi_lo && \
 	  (i1).ip_posid == (i2).ip_posid )
+/* downlinks are identified by the child block alone; see BTreeTupleGetNAtts */
 #define BTEntrySame(i1, i2) \
-	BTTidSame((i1)->t_tid, (i2)->t_tid)
+	( (i1)->t_tid.ip_blkid.bi_hi == (i2)->t_tid.ip_blkid.bi_hi && \
+	  (i1)->t_tid.ip_blkid.bi_lo == (i2)->t_tid.ip_blkid.bi_lo )
 
 
 /*
@@ -204,6 +224,90 @@ typedef struct BTMetaPageData
 #define P_FIRSTKEY			((OffsetNumber) 2)
 #define P_FIRSTDATAKEY(opaque)	(P_RIGHTMOST(opaque) ? P_HIKEY : P_FIRSTKEY)
 
+/*
+ *	Posting list tuples.
+ *
+ *	In a non-unique index, a data item on a leaf page may stand for several
+ *	heap tuples that have the same key.  Such a "posting list tuple" holds
+ *	the key just once, followed by a sorted array of heap TIDs.  Posting list
+ *	tuples are marked with BT_IS_POSTING in t_info; their t_tid does not
+ *	point to the heap, but instead records the number of TIDs in the posting
+ *	list in its offset number and the byte offset of the list within the
+ *	tuple in its block number.  The key part of the tuple is laid out just
+ *	as in an ordinary tuple, so comparisons and index_getattr() need not
+ *	know about posting lists.
+ *
+ *	Posting lists are only ever built on leaf pages, by merging duplicates
+ *	when a page would otherwise have to be split (see nbtdedup.c) or during
+ *	index build.  High keys and downlinks never carry a posting list.
+ *
+ *	MaxTIDsPerBTreePage is an upper bound on the number of heap TIDs that
+ *	one leaf page can reference, counting every TID in every posting list.
+ */
+#define BT_IS_POSTING			INDEX_AM_RESERVED_BIT
+
+#define BTreeTupleIsPosting(itup) \
+	(((itup)->t_info & BT_IS_POSTING) != 0)
+#define BTreeTupleGetNPosting(itup) \
+	((int) ItemPointerGetOffsetNumber(&(itup)->t_tid))
+#define BTreeTupleGetPostingOffset(itup) \
+	((Size) ItemPointerGetBlockNumber(&(itup)->t_tid))
+#define BTreeTupleSetPosting(itup, nposting, offset) \
+	do { \
+		(itup)->t_info |= BT_IS_POSTING; \
+		ItemPointerSetBlockNumber(&(itup)->t_tid, (offset)); \
+		ItemPointerSetOffsetNumber(&(itup)->t_tid, (nposting)); \
+	} while (0)
+#define BTreeTupleGetPosting(itup) \
+	((ItemPointer) ((char *) (itup) + BTreeTupleGetPostingOffset(itup)))
+#define BTreeTupleGetPostingN(itup, n) \
+	(BTreeTupleGetPosting(itup) + (n))
+#define BTreeTupleGetNTids(itup) \
+	(BTreeTupleIsPosting(itup) ? BTreeTupleGetNPosting(itup) : 1)
+/* size of the key part of a leaf tuple, including the tuple header */
+#define BTreeTupleGetKeySize(itup) \
+	(BTreeTupleIsPosting(itup) ? BTreeTupleGetPostingOffset(itup) : \
+	 IndexTupleSize(itup))
+
+#define MaxTIDsPerBTreePage \
+	((int) ((BLCKSZ - SizeOfPageHeaderData - sizeof(BTPageOpaqueData)) / \
+			sizeof(ItemPointerData)))
+
+/*
+ *	Truncated pivot tuples.
+ *
+ *	High keys and the items on internal pages ("pivot tuples") only have to
+ *	separate the key space, so when a leaf page is split the new high key
+ *	keeps just as many leading key attributes as are needed to tell the last
+ *	item on the left apart from the first item on the right (see
+ *	_bt_truncate).  The attributes left out behave as minus infinity in
+ *	comparisons, so everything on the left page is strictly less than the
+ *	new high key, and everything on the right page is greater or equal.
+ *	Shorter pivots mean more downlinks per internal page, and so a tree
+ *	with fewer levels.
+ *
+ *	A truncated pivot tuple has BT_IS_TRUNCATED set in t_info, and keeps
+ *	its number of attributes in the offset number of t_tid; only the block
+ *	number is used as a downlink.  This is the same bit that marks posting
+ *	list tuples, which never act as pivots: which meaning applies depends on
+ *	where the tuple sits.  BTreeTupleGetNAtts is only valid for pivots.
+ */
+#define BT_IS_TRUNCATED			INDEX_AM_RESERVED_BIT
+
+#define BTreeTupleIsTruncated(itup) \
+	(((itup)->t_info & BT_IS_TRUNCATED) != 0)
+#define BTreeTupleGetNAtts(itup, rel) \
+	(BTreeTupleIsTruncated(itup) ? \
+	 (int) ItemPointerGetOffsetNumber(&(itup)->t_tid) : \
+	 RelationGetNumberOfAttributes(rel))
+#define BTreeTupleSetDownLink(itup, blkno) \
+	do { \
+		if (BTreeTupleIsTruncated(itup)) \
+			ItemPointerSetBlockNumber(&(itup)->t_tid, (blkno)); \
+		else \
+			ItemPointerSet(&(itup)->t_tid, (blkno), P_HIKEY); \
+	} while (0)
+
 /*
  * XLOG records for btree operations
  *
@@ -275,9 +379,9 @@ typedef struct xl_btree_insert
  *
  * The left page's data portion contains the new item, if it's the _L variant.
  * (In the _R variants, the new item is one of the right page's tuples.)
- * If level > 0, an IndexTuple representing the HIKEY of the left page
- * follows.  We don't need this on leaf pages, because it's the same as the
- * leftmost key in the new right page.
+ * An IndexTuple representing the HIKEY of the left page follows.  On leaf
+ * pages, it's a truncated copy of the leftmost key in the new right page
+ * (see _bt_truncate), which replay couldn't easily reconstruct.
  *
  * Backup Blk 1: new right page
  *
@@ -346,15 +450,21 @@ typedef struct xl_btree_reuse_page
  *
  * Note that the *last* WAL record in any vacuum of an index is allowed to
  * have a zero length array of offsets. Earlier records must have at least one.
+ *
+ * Posting list tuples that lose only some of their heap TIDs are replaced in
+ * place rather than deleted.  The block data holds the offsets of the
+ * replaced tuples, then the replacement tuples themselves (each MAXALIGN'd),
+ * then the offsets of the deleted tuples.
  */
 typedef struct xl_btree_vacuum
 {
 	BlockNumber lastBlockVacuumed;
+	uint16		nupdated;		/* number of replaced posting list tuples */
 
-	/* TARGET OFFSET NUMBERS FOLLOW */
+	/* UPDATED OFFSETS, UPDATED TUPLES, TARGET OFFSET NUMBERS FOLLOW */
 } xl_btree_vacuum;
 
-#define SizeOfBtreeVacuum	(offsetof(xl_btree_vacuum, lastBlockVacuumed) + sizeof(BlockNumber))
+#define SizeOfBtreeVacuum	(offsetof(xl_btree_vacuum, nupdated) + sizeof(uint16))
 
 /*
  * This is what we need to know about marking an empty branch for deletion.
@@ -548,7 +658,11 @@ typedef struct BTScanPosData
 	int			lastItem;		/* last valid index in items[] */
 	int			itemIndex;		/* current index in items[] */
 
-	BTScanPosItem items[MaxIndexTuplesPerPage]; /* MUST BE LAST */
+	/* heap prefetching state, see _bt_prefetch_heap() */
+	int			prefetchItem;	/* last item considered for prefetching */
+	int			prefetchPending;	/* prefetched blocks not yet reached */
+
+	BTScanPosItem items[MaxTIDsPerBTreePage];	/* MUST BE LAST */
 } BTScanPosData;
 
 typedef BTScanPosData *BTScanPos;
@@ -609,10 +723,38 @@ typedef struct BTScanOpaqueData
 	BTArrayKeyInfo *arrayKeys;	/* info about each equality-type array key */
 	MemoryContext arrayContext; /* scan-lifespan context for array data */
 
+	/* workspace for skip scans, see _bt_preprocess_skip_key() */
+	bool		skipScan;		/* stepping through leading column values? */
+	int			skipState;		/* BT_SKIP_xxx, see below */
+	ScanDirection skipDir;		/* scan direction for BT_SKIP_BOUND */
+	Datum		skipValue;		/* current leading column value */
+	bool		skipIsNull;		/* ... or is it NULL? */
+	uint32		skipGeneration; /* bumped whenever skipValue changes */
+	ScanKey		skipKeyData;	/* skip key, then copy of scan->keyData */
+	BlockNumber skipLastBlock;	/* last leaf page read by the scan */
+	int			skipNumWasted;	/* consecutive probes that gained nothing */
+	FmgrInfo	skipEqFunc;		/* "=" for the leading column */
+	FmgrInfo	skipGeFunc;		/* ">=" for the leading column */
+	FmgrInfo	skipLeFunc;		/* "<=" for the leading column */
+	MemoryContext skipContext;	/* scan-lifespan context for skip data */
+
+	/* skip state as of the marked position */
+	int			markSkipState;
+	ScanDirection markSkipDir;
+	Datum		markSkipValue;
+	bool		markSkipIsNull;
+	uint32		markSkipGeneration;
+
 	/* info about killed items if any (killedItems is NULL if never used) */
 	int		   *killedItems;	/* currPos.items indexes of killed items */
 	int			numKilled;		/* number of currently stored items */
 
+	/* leaf page the last _bt_first() search ended on, kept across rescans */
+	BlockNumber lastLeaf;
+
+	/* current heap prefetch distance, see _bt_prefetch_heap() */
+	int			prefetchTarget;
+
 	/*
 	 * If we are doing an index-only scan, these are the tuple storage
 	 * workspaces for the currPos and markPos respectively.  Each is of size
@@ -637,6 +779,21 @@ typedef struct BTScanOpaqueData
 
 typedef BTScanOpaqueData *BTScanOpaque;
 
+/*
+ * Skip scan states.  A skip scan is used when there are scan keys on the
+ * second index column but none on the first; we then make up a key on the
+ * first column (skipKeyData[0]) and run one ordinary scan per distinct
+ * value of that column.  In BT_SKIP_EQUAL state the made-up key is
+ * "col1 = skipValue".  When repeated probes for the next value show the
+ * values are too dense to be worth skipping over, we switch to
+ * BT_SKIP_BOUND, where the key is "col1 >= skipValue" (or <=, as needed for
+ * skipDir) and the rest of the index is read without further skipping.
+ * BT_SKIP_START means we have yet to find the first value.
+ */
+#define BT_SKIP_START		0
+#define BT_SKIP_EQUAL		1
+#define BT_SKIP_BOUND		2
+
 /*
  * We use some private sk_flags bits in preprocessed scan keys.  We're allowed
  * to use bits 16-31 (see skey.h).  The uppermost bits are copied from the
@@ -666,6 +823,15 @@ extern Datum btbulkdelete(PG_FUNCTION_ARGS);
 extern Datum btvacuumcleanup(PG_FUNCTION_ARGS);
 extern Datum btcanreturn(PG_FUNCTION_ARGS);
 extern Datum btoptions(PG_FUNCTION_ARGS);
+extern Datum btestimateparallelscan(PG_FUNCTION_ARGS);
+extern Datum btinitparallelscan(PG_FUNCTION_ARGS);
+
+/*
+ * prototypes for internal functions in nbtree.c
+ */
+extern bool _bt_parallel_seize(IndexScanDesc scan, BlockNumber *pageno);
+extern void _bt_parallel_release(IndexScanDesc scan, BlockNumber scan_page);
+extern void _bt_parallel_done(IndexScanDesc scan);
 
 /*
  * prototypes for functions in nbtinsert.c
@@ -689,13 +855,27 @@ extern Buffer _bt_relandgetbuf(Relation rel, Buffer obuf,
 extern void _bt_relbuf(Relation rel, Buffer buf);
 extern void _bt_pageinit(Page page, Size size);
 extern bool _bt_page_recyclable(Page page);
+extern void _bt_page_change_begin(Page page);
+extern void _bt_page_change_end(Page page);
+extern bool _bt_page_copy_unlocked(Buffer buf, Page copy);
 extern void _bt_delitems_delete(Relation rel, Buffer buf,
 					OffsetNumber *itemnos, int nitems, Relation heapRel);
 extern void _bt_delitems_vacuum(Relation rel, Buffer buf,
 					OffsetNumber *itemnos, int nitems,
-					BlockNumber lastBlockVacuumed);
+					OffsetNumber *updatable, IndexTuple *updated,
+					int nupdatable, BlockNumber lastBlockVacuumed);
+extern void _bt_replace_item(Page page, OffsetNumber offnum, IndexTuple itup);
 extern int	_bt_pagedel(Relation rel, Buffer buf);
 
+/*
+ * prototypes for functions in nbtdedup.c
+ */
+extern bool _bt_dedup_one_page(Relation rel, Buffer buf);
+extern bool _bt_keys_equal(IndexTuple a, IndexTuple b);
+extern IndexTuple _bt_form_posting(IndexTuple base, ItemPointer htids,
+				 int nhtids);
+extern IndexTuple _bt_key_copy(IndexTuple itup);
+
 /*
  * prototypes for functions in nbtsearch.c
  */
@@ -711,12 +891,15 @@ extern int32 _bt_compare(Relation rel, int keysz, ScanKey scankey,
 			Page page, OffsetNumber offnum);
 extern bool _bt_first(IndexScanDesc scan, ScanDirection dir);
 extern bool _bt_next(IndexScanDesc scan, ScanDirection dir);
+extern bool _bt_skip_first(IndexScanDesc scan, ScanDirection dir);
+extern void _bt_prefetch_heap(IndexScanDesc scan, ScanDirection dir);
 extern Buffer _bt_get_endpoint(Relation rel, uint32 level, bool rightmost);
 
 /*
  * prototypes for functions in nbtutils.c
  */
 extern ScanKey _bt_mkscankey(Relation rel, IndexTuple itup);
+extern ScanKey _bt_mkscankey_pivot(Relation rel, IndexTuple itup, int *keysz);
 extern ScanKey _bt_mkscankey_nodata(Relation rel);
 extern void _bt_freeskey(ScanKey skey);
 extern void _bt_freestack(BTStack stack);
@@ -725,11 +908,17 @@ extern void _bt_start_array_keys(IndexScanDesc scan, ScanDirection dir);
 extern bool _bt_advance_array_keys(IndexScanDesc scan, ScanDirection dir);
 extern void _bt_mark_array_keys(IndexScanDesc scan);
 extern void _bt_restore_array_keys(IndexScanDesc scan);
+extern void _bt_preprocess_skip_key(IndexScanDesc scan);
+extern void _bt_set_skip_value(IndexScanDesc scan, Datum value, bool isnull);
+extern void _bt_mark_skip_key(IndexScanDesc scan);
+extern void _bt_restore_skip_key(IndexScanDesc scan);
 extern void _bt_preprocess_keys(IndexScanDesc scan);
 extern IndexTuple _bt_checkkeys(IndexScanDesc scan,
 			  Page page, OffsetNumber offnum,
 			  ScanDirection dir, bool *continuescan);
 extern void _bt_killitems(IndexScanDesc scan);
+extern IndexTuple _bt_truncate(Relation rel, IndexTuple lastleft,
+			 IndexTuple firstright);
 extern BTCycleId _bt_vacuum_cycleid(Relation rel);
 extern BTCycleId _bt_start_vacuum(Relation rel);
 extern void _bt_end_vacuum(Relation rel);
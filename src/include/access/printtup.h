@@ -14,8 +14,15 @@
 #ifndef PRINTTUP_H
 #define PRINTTUP_H
 
+#include "lib/stringinfo.h"
 #include "utils/portal.h"
 
+/*
+ * A direct send function appends a value's binary representation, preceded
+ * by its length word, to a message buffer.  See GetDirectSendFunc.
+ */
+typedef void (*DirectSendFunc) (StringInfo buf, Datum value);
+
 extern DestReceiver *printtup_create_DR(CommandDest dest);
 
 extern void SetRemoteDestReceiverParams(DestReceiver *self, Portal portal);
@@ -23,6 +30,8 @@ extern void SetRemoteDestReceiverParams(DestReceiver *self, Portal portal);
 extern void SendRowDescriptionMessage(TupleDesc typeinfo, List *targetlist,
 						  int16 *formats);
 
+extern DirectSendFunc GetDirectSendFunc(Oid typsend);
+
 extern void debugStartup(DestReceiver *self, int operation,
 			 TupleDesc typeinfo);
 extern void debugtup(TupleTableSlot *slot, DestReceiver *self);
@@ -19,7 +19,26 @@
 #include "access/htup_details.h"
 #include "access/itup.h"
 #include "access/tupdesc.h"
+#include "port/atomics.h"
 
+/*
+ * Shared state for a parallel heap scan.
+ *
+ * Each backend participating in a parallel heap scan has its own
+ * HeapScanDesc in backend-private memory, and those objects all point to
+ * this structure, which lives in dynamic shared memory.  Participants claim
+ * blocks one at a time by atomically incrementing phs_nallocated; block
+ * numbers are handed out starting at phs_startblock and wrapping around at
+ * phs_nblocks, just like a non-parallel (possibly synchronized) seqscan.
+ */
+typedef struct ParallelHeapScanDescData
+{
+	Oid			phs_relid;		/* OID of relation to scan */
+	bool		phs_syncscan;	/* report location to syncscan logic? */
+	BlockNumber phs_nblocks;	/* # blocks in relation at start of scan */
+	BlockNumber phs_startblock; /* starting block number */
+	pg_atomic_uint32 phs_nallocated;	/* # blocks handed out so far */
+} ParallelHeapScanDescData;
 
 typedef struct HeapScanDescData
 {
@@ -34,6 +53,7 @@ typedef struct HeapScanDescData
 	bool		rs_allow_strat; /* allow or disallow use of access strategy */
 	bool		rs_allow_sync;	/* allow or disallow use of syncscan */
 	bool		rs_temp_snap;	/* unregister snapshot at scan end? */
+	ParallelHeapScanDesc rs_parallel;	/* parallel scan information */
 
 	/* state set up at initscan time */
 	BlockNumber rs_nblocks;		/* total number of blocks in rel */
@@ -50,6 +70,17 @@ typedef struct HeapScanDescData
 	Buffer		rs_cbuf;		/* current buffer in scan, if any */
 	/* NB: if rs_cbuf is not InvalidBuffer, we hold a pin on that buffer */
 
+	/* read-ahead state, see heap_prefetch_ahead() */
+	BlockNumber rs_prefetch_next;	/* next page to prefetch, counted from
+									 * rs_startblock */
+	int			rs_prefetch_target;		/* current read-ahead distance */
+
+	/* pages already read by a combined read, see heap_read_page() */
+	Buffer	   *rs_rabufs;		/* pinned buffers of the following pages */
+	int			rs_nrabufs;		/* number of entries in rs_rabufs */
+	int			rs_rabufnext;	/* index of next entry to hand out */
+	BlockNumber rs_rablock;		/* block number of that entry */
+
 	/* these fields only used in page-at-a-time mode and for bitmap scans */
 	int			rs_cindex;		/* current tuple's index in vistuples */
 	int			rs_ntuples;		/* number of visible tuples on page */
@@ -105,8 +136,24 @@ typedef struct IndexScanDescData
 
 	/* state data for traversing HOT chains in index_getnext */
 	bool		xs_continue_hot;	/* T if must keep walking HOT chain */
+
+	/* shared state of a parallel scan, or NULL */
+	ParallelIndexScanDesc parallel_scan;
 }	IndexScanDescData;
 
+/*
+ * Shared state for a parallel index scan.  This lives in dynamic shared
+ * memory, followed at ps_offset by the index AM's own shared state, which
+ * the AM's aminitparallelscan sets up and which decides how the
+ * participants divide the scan between them.
+ */
+typedef struct ParallelIndexScanDescData
+{
+	Oid			ps_relid;		/* OID of the heap relation */
+	Oid			ps_indexid;		/* OID of the index */
+	Size		ps_offset;		/* offset of AM-specific state */
+} ParallelIndexScanDescData;
+
 /* Struct for heap-or-index scans of system tables */
 typedef struct SysScanDescData
 {
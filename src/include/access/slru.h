@@ -36,6 +36,21 @@
  */
 #define SLRU_PAGES_PER_SEGMENT	32
 
+/*
+ * The buffer slots of an SLRU are divided into banks of SLRU_BANK_SIZE
+ * slots (the last bank also takes any remainder), and a page can only be
+ * kept in the bank selected by its page number.  Looking up a page, or
+ * choosing a victim to evict, thus only needs to examine one bank, however
+ * many buffers are configured.
+ *
+ * SLRU_MIN_BUFFERS and SLRU_MAX_BUFFERS bound the configurable buffer
+ * counts; the latest page is never evicted, so a bank needs at least two
+ * slots for anything else to be read in.
+ */
+#define SLRU_BANK_SIZE			16
+#define SLRU_MIN_BUFFERS		4
+#define SLRU_MAX_BUFFERS		131072
+
 /*
  * Page status codes.  Note that these do not include the "dirty" bit.
  * page_dirty can be TRUE only in the VALID or WRITE_IN_PROGRESS states;
@@ -60,6 +75,9 @@ typedef struct SlruSharedData
 	/* Number of buffers managed by this SLRU structure */
 	int			num_slots;
 
+	/* Number of banks the buffers are divided into; see SLRU_BANK_SIZE */
+	int			num_banks;
+
 	/*
 	 * Arrays holding info for each buffer slot.  Page number is undefined
 	 * when status is EMPTY, as is page_lru_count.
@@ -83,15 +101,17 @@ typedef struct SlruSharedData
 	int			lsn_groups_per_page;
 
 	/*----------
-	 * We mark a page "most recently used" by setting
-	 *		page_lru_count[slotno] = ++cur_lru_count;
-	 * The oldest page is therefore the one with the highest value of
-	 *		cur_lru_count - page_lru_count[slotno]
+	 * Each bank keeps its own LRU clock.  We mark a page "most recently
+	 * used" by setting
+	 *		page_lru_count[slotno] = ++bank_cur_lru_count[bankno];
+	 * The oldest page in a bank is therefore the one with the highest value
+	 * of
+	 *		bank_cur_lru_count[bankno] - page_lru_count[slotno]
 	 * The counts will eventually wrap around, but this calculation still
 	 * works as long as no page's age exceeds INT_MAX counts.
 	 *----------
 	 */
-	int			cur_lru_count;
+	int		   *bank_cur_lru_count;
 
 	/*
 	 * latest_page_number is the page number of the current end of the log;
@@ -16,8 +16,10 @@
 
 #include "access/itup.h"
 #include "access/spgist.h"
+#include "lib/pairingheap.h"
 #include "nodes/tidbitmap.h"
 #include "storage/buf.h"
+#include "utils/geo_decls.h"
 #include "utils/relcache.h"
 
 
@@ -129,6 +131,32 @@ typedef struct SpGistState
 	bool		isBuild;		/* true if doing index build */
 } SpGistState;
 
+/*
+ * A work item of an index scan: either a page (or a tuple chain on one) yet
+ * to be visited, or, in an ordered scan, a heap tuple found to match that
+ * hasn't been returned yet.  Unordered scans keep them in a stack, ordered
+ * scans in a pairing heap, ordered by distances.
+ */
+typedef struct SpGistSearchItem
+{
+	pairingheap_node phNode;	/* pairing heap node, in ordered scans */
+	Datum		value;			/* value reconstructed from parent, or leaf
+								 * value for a heap tuple */
+	void	   *traversalValue; /* opclass-specific traverse value */
+	int			level;			/* level of items on this page */
+	ItemPointerData heapPtr;	/* heap TID, or block and offset to scan from */
+	bool		isNull;			/* is the leaf value NULL? */
+	bool		isLeaf;			/* is this a heap tuple rather than a page? */
+	bool		recheck;		/* must the quals be rechecked? */
+	bool		recheckDistances;	/* must the distances be rechecked? */
+
+	/* array with numberOfOrderBys entries */
+	double		distances[FLEXIBLE_ARRAY_MEMBER];
+} SpGistSearchItem;
+
+#define SizeOfSpGistSearchItem(n_distances) \
+	(offsetof(SpGistSearchItem, distances) + sizeof(double) * (n_distances))
+
 /*
  * Private state of an index scan
  */
@@ -136,6 +164,7 @@ typedef struct SpGistScanOpaqueData
 {
 	SpGistState state;			/* see above */
 	MemoryContext tempCxt;		/* short-lived memory context */
+	MemoryContext traversalCxt; /* for search items and traversal values */
 
 	/* Control flags showing whether to search nulls and/or non-nulls */
 	bool		searchNulls;	/* scan matches (all) null entries */
@@ -145,8 +174,18 @@ typedef struct SpGistScanOpaqueData
 	int			numberOfKeys;	/* number of index qualifier conditions */
 	ScanKey		keyData;		/* array of index qualifier descriptors */
 
-	/* Stack of yet-to-be-visited pages */
-	List	   *scanStack;		/* List of ScanStackEntrys */
+	/* Ordering operators, and the distance datatype of each */
+	int			numberOfOrderBys;
+	ScanKey		orderByData;
+	Oid		   *orderByTypes;
+
+	/* Stack of yet-to-be-visited pages, in unordered scans */
+	List	   *scanStack;		/* List of SpGistSearchItems */
+
+	/* Queue of pages and heap tuples, in ordered scans */
+	pairingheap *scanQueue;
+	double	   *zeroDistances;	/* distances to give the root items */
+	double	   *infDistances;	/* distances to give NULL items */
 
 	/* These fields are only used in amgetbitmap scans: */
 	TIDBitmap  *tbm;			/* bitmap being filled */
@@ -161,6 +200,10 @@ typedef struct SpGistScanOpaqueData
 	bool		recheck[MaxIndexTuplesPerPage]; /* their recheck flags */
 	IndexTuple	indexTups[MaxIndexTuplesPerPage];		/* reconstructed tuples */
 
+	/* distances of the returned tuple, in ordered scans (nPtrs is 1 then) */
+	double	   *distances;
+	bool		recheckDistances;
+
 	/*
 	 * Note: using MaxIndexTuplesPerPage above is a bit hokey since
 	 * SpGistLeafTuples aren't exactly IndexTuples; however, they are larger,
@@ -648,4 +691,9 @@ extern void spgPageIndexMultiDelete(SpGistState *state, Page page,
 extern bool spgdoinsert(Relation index, SpGistState *state,
 			ItemPointer heapPtr, Datum datum, bool isnull);
 
+/* spgproc.c */
+extern double *spg_key_orderbys_distances(Datum key, bool isLeaf,
+						   ScanKey orderbys, int norderbys);
+extern BOX *box_copy(BOX *orig);
+
 #endif   /* SPGIST_PRIVATE_H */
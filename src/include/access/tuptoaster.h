@@ -23,6 +23,22 @@
  */
 #define TOAST_INDEX_HACK
 
+/*
+ * Compression methods for compressible fields.  The values are stored in
+ * compressed datums (see VARCOMPRESS_METHOD_4B_C), so they mustn't change.
+ * A column's method is chosen with its "compression" attribute option, or
+ * else by default_toast_compression.
+ */
+typedef enum ToastCompressionMethod
+{
+	TOAST_PGLZ_COMPRESSION = 0,
+	TOAST_LZ4_COMPRESSION = 1,
+	TOAST_ZSTD_COMPRESSION = 2
+} ToastCompressionMethod;
+
+/* GUC variable */
+extern int	default_toast_compression;
+
 
 /*
  * Find the maximum size of a tuple if there are to be N tuples per page.
@@ -174,6 +190,60 @@ extern struct varlena *heap_tuple_untoast_attr_slice(struct varlena * attr,
 							  int32 sliceoffset,
 							  int32 slicelength);
 
+/* ----------
+ * Detoast iterators -
+ *
+ *		An iterator detoasts a value a piece at a time, so that a caller
+ *		that may not need all of the value can stop early without fetching
+ *		or decompressing the rest.  The first iter->done bytes of the data
+ *		are available at VARDATA(iter->buf); iter->buf is allocated at the
+ *		full size of the value, so pointers into it stay valid as the
+ *		iterator advances.  The value must remain valid as long as the
+ *		iterator is in use.
+ *
+ *		detoast_iterate() makes more of the data available and returns
+ *		true, or returns false if it was all available already.
+ *		detoast_iterate_to() makes at least the first "needed" bytes
+ *		available, or all of them if there are fewer.
+ * ----------
+ */
+typedef struct DetoastIteratorData
+{
+	struct varlena *buf;		/* detoasted data, in a 4-byte header varlena */
+	int32		rawsize;		/* total length of the data */
+	int32		done;			/* length of the data available so far */
+	/* private state */
+	struct varlena *source;		/* external or compressed value */
+	struct varlena *compressed; /* compressed data fetched so far, or NULL */
+	int32		compressed_size;	/* length of all the compressed data */
+	bool		shared;			/* belongs to an expanded toast value */
+} DetoastIteratorData;
+
+typedef DetoastIteratorData *DetoastIterator;
+
+extern DetoastIterator create_detoast_iterator(struct varlena * attr);
+extern bool detoast_iterate(DetoastIterator iter);
+extern void detoast_iterate_to(DetoastIterator iter, int32 needed);
+extern void free_detoast_iterator(DetoastIterator iter);
+
+/* ----------
+ * Expanded toast values -
+ *
+ *		An expanded toast value is an expanded object standing for an
+ *		externally stored value, which it detoasts on demand.  Flattening
+ *		it detoasts the whole value, but only the first time, and detoast
+ *		iterators created for it all share its own iterator.  So a value
+ *		that is referenced several times, by functions that detoast it or
+ *		iterate over it, is fetched and decompressed at most once, and no
+ *		further than needed.
+ *
+ *		toast_expanded_source() returns the toast pointer an expanded toast
+ *		value was made from, or attr itself if it's anything else.
+ * ----------
+ */
+extern Datum expand_toast_value(Datum value, MemoryContext parentcontext);
+extern struct varlena *toast_expanded_source(struct varlena * attr);
+
 /* ----------
  * toast_flatten_tuple -
  *
@@ -199,7 +269,26 @@ extern Datum toast_flatten_tuple_to_datum(HeapTupleHeader tup,
  *	Create a compressed version of a varlena datum, if possible
  * ----------
  */
-extern Datum toast_compress_datum(Datum value);
+extern Datum toast_compress_datum(Datum value, int method);
+
+/* ----------
+ * toast_compression_method_name -
+ * toast_compression_method_by_name -
+ *
+ *	Convert between compression methods and their names.  Lookup by name
+ *	returns -1 for unknown methods and those the server was built without.
+ * ----------
+ */
+extern const char *toast_compression_method_name(int method);
+extern int	toast_compression_method_by_name(const char *name);
+
+/* ----------
+ * toast_validate_compression_option -
+ *
+ *	Validate the value of the "compression" attribute option
+ * ----------
+ */
+extern void toast_validate_compression_option(char *value);
 
 /* ----------
  * toast_raw_datum_size -
@@ -31,7 +31,7 @@
 /*
  * Each page of XLOG file has a header like this:
  */
-#define XLOG_PAGE_MAGIC 0xD085	/* can be used as WAL version indicator */
+#define XLOG_PAGE_MAGIC 0xD08B	/* can be used as WAL version indicator */
 
 typedef struct XLogPageHeaderData
 {
@@ -289,6 +289,7 @@ extern bool ArchiveRecoveryRequested;
 extern bool InArchiveRecovery;
 extern bool StandbyMode;
 extern char *recoveryRestoreCommand;
+extern int	recoveryRestorePrefetch;
 
 /*
  * Prototypes for functions in xlogarchive.c
@@ -299,6 +300,7 @@ extern bool RestoreArchivedFile(char *path, const char *xlogfname,
 extern void ExecuteRecoveryCommand(char *command, char *commandName,
 					   bool failOnerror);
 extern void KeepFileRestoredFromArchive(char *path, char *xlogfname);
+extern void RestorePrefetchCleanup(void);
 extern void XLogArchiveNotify(const char *xlog);
 extern void XLogArchiveNotifySeg(XLogSegNo segno);
 extern void XLogArchiveForceDone(const char *xlog);
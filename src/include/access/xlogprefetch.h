@@ -0,0 +1,36 @@
+/*-------------------------------------------------------------------------
+ *
+ * xlogprefetch.h
+ *		Declarations for read-ahead of blocks referenced by WAL during
+ *		recovery.
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * src/include/access/xlogprefetch.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef XLOGPREFETCH_H
+#define XLOGPREFETCH_H
+
+#include "access/xlogdefs.h"
+#include "fmgr.h"
+
+/* GUC variable, in kilobytes of WAL */
+extern int	recovery_prefetch_distance;
+
+/* Opaque state of the read-ahead stage of the startup process */
+typedef struct XLogPrefetcher XLogPrefetcher;
+
+extern Size XLogPrefetchShmemSize(void);
+extern void XLogPrefetchShmemInit(void);
+
+extern XLogPrefetcher *XLogPrefetcherAllocate(void);
+extern void XLogPrefetcherFree(XLogPrefetcher *prefetcher);
+extern void XLogPrefetcherReadAhead(XLogPrefetcher *prefetcher,
+						XLogRecPtr replayEndPtr, TimeLineID replayTLI);
+
+extern Datum pg_stat_get_recovery_prefetch(PG_FUNCTION_ARGS);
+
+#endif   /* XLOGPREFETCH_H */
@@ -0,0 +1,26 @@
+/*-------------------------------------------------------------------------
+ *
+ * xlogredoworker.h
+ *		Parallel application of WAL records during recovery.
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * src/include/access/xlogredoworker.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef XLOGREDOWORKER_H
+#define XLOGREDOWORKER_H
+
+#include "access/xlogreader.h"
+
+/* GUC variable */
+extern int	recovery_workers;
+
+extern bool RedoWorkerDispatch(XLogReaderState *record);
+extern void RedoWorkersShutdown(void);
+
+extern void RedoWorkerMain(Datum main_arg);
+
+#endif   /* XLOGREDOWORKER_H */
@@ -562,6 +562,7 @@ typedef NameData *Name;
 /* MAXALIGN covers only built-in types, not buffers */
 #define BUFFERALIGN(LEN)		TYPEALIGN(ALIGNOF_BUFFER, (LEN))
 #define CACHELINEALIGN(LEN)		TYPEALIGN(PG_CACHE_LINE_SIZE, (LEN))
+#define IOALIGN(LEN)			TYPEALIGN(PG_IO_ALIGN_SIZE, (LEN))
 
 #define TYPEALIGN_DOWN(ALIGNVAL,LEN)  \
 	(((uintptr_t) (LEN)) & ~((uintptr_t) ((ALIGNVAL) - 1)))
@@ -919,6 +920,18 @@ typedef NameData *Name;
 #define pg_unreachable() abort()
 #endif
 
+/*
+ * Hint that the memory at the given address will be read soon, so that the
+ * CPU can start fetching it into cache while we do other work.  This is only
+ * a hint: it has no visible effect, and never faults even if the address
+ * turns out to be invalid.
+ */
+#ifdef __GNUC__
+#define pg_prefetch_mem(addr) __builtin_prefetch(addr)
+#else
+#define pg_prefetch_mem(addr) ((void) 0)
+#endif
+
 
 /*
  * Function inlining support -- Allow modules to define functions that may be
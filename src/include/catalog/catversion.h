@@ -53,6 +53,6 @@
  */
 
 /*							yyyymmddN */
-#define CATALOG_VERSION_NO	201505311
+#define CATALOG_VERSION_NO	201510174
 
 #endif
@@ -109,6 +109,14 @@ extern double IndexBuildHeapRangeScan(Relation heapRelation,
 						BlockNumber end_blockno,
 						IndexBuildCallback callback,
 						void *callback_state);
+extern double IndexBuildHeapParallelScan(Relation heapRelation,
+						   Relation indexRelation,
+						   IndexInfo *indexInfo,
+						   ParallelHeapScanDesc parallel_scan,
+						   IndexBuildCallback callback,
+						   void *callback_state);
+extern int	IndexBuildParallelWorkers(Relation heapRelation,
+						  IndexInfo *indexInfo);
 
 extern void validate_index(Oid heapId, Oid indexId, Snapshot snapshot);
 
@@ -767,6 +767,7 @@ DATA(insert (	4015   600 600 5 s	508 4000 0 ));
 DATA(insert (	4015   600 600 10 s 509 4000 0 ));
 DATA(insert (	4015   600 600 6 s	510 4000 0 ));
 DATA(insert (	4015   600 603 8 s	511 4000 0 ));
+DATA(insert (	4015   600 600 15 o 517 4000 1970 ));
 
 /*
  * SP-GiST kd_point_ops
@@ -777,6 +778,7 @@ DATA(insert (	4016   600 600 5 s	508 4000 0 ));
 DATA(insert (	4016   600 600 10 s 509 4000 0 ));
 DATA(insert (	4016   600 600 6 s	510 4000 0 ));
 DATA(insert (	4016   600 603 8 s	511 4000 0 ));
+DATA(insert (	4016   600 600 15 o 517 4000 1970 ));
 
 /*
  * SP-GiST text_ops
@@ -1115,5 +1117,53 @@ DATA(insert (	4104	603  603 11 s	  2573	  3580 0 ));
 DATA(insert (	4104	603  603 12 s	  2572	  3580 0 ));
 /* we could, but choose not to, supply entries for strategies 13 and 14 */
 DATA(insert (	4104	603  600  7 s	   433	  3580 0 ));
+/* bloom int4 */
+DATA(insert (	3307	  23   23 1 s	    96	  3580 0 ));
+/* bloom int8 */
+DATA(insert (	3308	  20   20 1 s	   410	  3580 0 ));
+/* bloom text */
+DATA(insert (	3309	  25   25 1 s	    98	  3580 0 ));
+/* bloom uuid */
+DATA(insert (	3310	2950 2950 1 s	  2972	  3580 0 ));
+/* bloom timestamp */
+DATA(insert (	3311	1114 1114 1 s	  2060	  3580 0 ));
+/* bloom timestamptz */
+DATA(insert (	3312	1184 1184 1 s	  1320	  3580 0 ));
+/* minmax multi int4 */
+DATA(insert (	3313	  23   23 1 s	    97	  3580 0 ));
+DATA(insert (	3313	  23   23 2 s	   523	  3580 0 ));
+DATA(insert (	3313	  23   23 3 s	    96	  3580 0 ));
+DATA(insert (	3313	  23   23 4 s	   525	  3580 0 ));
+DATA(insert (	3313	  23   23 5 s	   521	  3580 0 ));
+/* minmax multi int8 */
+DATA(insert (	3314	  20   20 1 s	   412	  3580 0 ));
+DATA(insert (	3314	  20   20 2 s	   414	  3580 0 ));
+DATA(insert (	3314	  20   20 3 s	   410	  3580 0 ));
+DATA(insert (	3314	  20   20 4 s	   415	  3580 0 ));
+DATA(insert (	3314	  20   20 5 s	   413	  3580 0 ));
+/* minmax multi float8 */
+DATA(insert (	3315	 701  701 1 s	   672	  3580 0 ));
+DATA(insert (	3315	 701  701 2 s	   673	  3580 0 ));
+DATA(insert (	3315	 701  701 3 s	   670	  3580 0 ));
+DATA(insert (	3315	 701  701 4 s	   675	  3580 0 ));
+DATA(insert (	3315	 701  701 5 s	   674	  3580 0 ));
+/* minmax multi date */
+DATA(insert (	3316	1082 1082 1 s	  1095	  3580 0 ));
+DATA(insert (	3316	1082 1082 2 s	  1096	  3580 0 ));
+DATA(insert (	3316	1082 1082 3 s	  1093	  3580 0 ));
+DATA(insert (	3316	1082 1082 4 s	  1098	  3580 0 ));
+DATA(insert (	3316	1082 1082 5 s	  1097	  3580 0 ));
+/* minmax multi timestamp */
+DATA(insert (	3317	1114 1114 1 s	  2062	  3580 0 ));
+DATA(insert (	3317	1114 1114 2 s	  2063	  3580 0 ));
+DATA(insert (	3317	1114 1114 3 s	  2060	  3580 0 ));
+DATA(insert (	3317	1114 1114 4 s	  2065	  3580 0 ));
+DATA(insert (	3317	1114 1114 5 s	  2064	  3580 0 ));
+/* minmax multi timestamptz */
+DATA(insert (	3318	1184 1184 1 s	  1322	  3580 0 ));
+DATA(insert (	3318	1184 1184 2 s	  1323	  3580 0 ));
+DATA(insert (	3318	1184 1184 3 s	  1320	  3580 0 ));
+DATA(insert (	3318	1184 1184 4 s	  1325	  3580 0 ));
+DATA(insert (	3318	1184 1184 5 s	  1324	  3580 0 ));
 
 #endif   /* PG_AMOP_H */
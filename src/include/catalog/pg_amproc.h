@@ -101,6 +101,7 @@ DATA(insert (	1970   701 701 1 355 ));
 DATA(insert (	1970   701 701 2 3133 ));
 DATA(insert (	1970   701 700 1 2195 ));
 DATA(insert (	1974   869 869 1 926 ));
+DATA(insert (	1974   869 869 2 3296 ));
 DATA(insert (	1976   21 21 1 350 ));
 DATA(insert (	1976   21 21 2 3129 ));
 DATA(insert (	1976   21 23 1 2190 ));
@@ -114,6 +115,7 @@ DATA(insert (	1976   20 20 2 3131 ));
 DATA(insert (	1976   20 23 1 2189 ));
 DATA(insert (	1976   20 21 1 2193 ));
 DATA(insert (	1982   1186 1186 1 1315 ));
+DATA(insert (	1982   1186 1186 2 3295 ));
 DATA(insert (	1984   829 829 1 836 ));
 DATA(insert (	1986   19 19 1 359 ));
 DATA(insert (	1986   19 19 2 3135 ));
@@ -134,6 +136,7 @@ DATA(insert (	2233   703 703 1  380 ));
 DATA(insert (	2234   704 704 1  381 ));
 DATA(insert (	2789   27 27 1 2794 ));
 DATA(insert (	2968   2950 2950 1 2960 ));
+DATA(insert (	2968   2950 2950 2 3294 ));
 DATA(insert (	2994   2249 2249 1 2987 ));
 DATA(insert (	3194   2249 2249 1 3187 ));
 DATA(insert (	3253   3220 3220 1 3251 ));
@@ -193,6 +196,7 @@ DATA(insert (	1029   600 600 6 2582 ));
 DATA(insert (	1029   600 600 7 2584 ));
 DATA(insert (	1029   600 600 8 3064 ));
 DATA(insert (	1029   600 600 9 3282 ));
+DATA(insert (	1029   600 600 10 3353 ));
 DATA(insert (	2593   603 603 1 2578 ));
 DATA(insert (	2593   603 603 2 2583 ));
 DATA(insert (	2593   603 603 3 2579 ));
@@ -239,6 +243,7 @@ DATA(insert (	3919   3831 3831 5 3879 ));
 DATA(insert (	3919   3831 3831 6 3880 ));
 DATA(insert (	3919   3831 3831 7 3881 ));
 DATA(insert (	3919   3831 3831 9 3996 ));
+DATA(insert (	3919   3831 3831 10 3354 ));
 DATA(insert (	3550   869 869 1 3553 ));
 DATA(insert (	3550   869 869 2 3554 ));
 DATA(insert (	3550   869 869 3 3555 ));
@@ -659,5 +664,77 @@ DATA(insert (	4104   603	 603  3  4107 ));
 DATA(insert (	4104   603	 603  4  4108 ));
 DATA(insert (	4104   603	 603  11 4067 ));
 DATA(insert (	4104   603	 603  13  187 ));
+/* bloom int4 */
+DATA(insert (	3307    23	  23   1 3319 ));
+DATA(insert (	3307    23	  23   2 3320 ));
+DATA(insert (	3307    23	  23   3 3321 ));
+DATA(insert (	3307    23	  23   4 3322 ));
+DATA(insert (	3307    23	  23  15  450 ));
+/* bloom int8 */
+DATA(insert (	3308    20	  20   1 3319 ));
+DATA(insert (	3308    20	  20   2 3320 ));
+DATA(insert (	3308    20	  20   3 3321 ));
+DATA(insert (	3308    20	  20   4 3322 ));
+DATA(insert (	3308    20	  20  15  949 ));
+/* bloom text */
+DATA(insert (	3309    25	  25   1 3319 ));
+DATA(insert (	3309    25	  25   2 3320 ));
+DATA(insert (	3309    25	  25   3 3321 ));
+DATA(insert (	3309    25	  25   4 3322 ));
+DATA(insert (	3309    25	  25  15  400 ));
+/* bloom uuid */
+DATA(insert (	3310  2950	2950   1 3319 ));
+DATA(insert (	3310  2950	2950   2 3320 ));
+DATA(insert (	3310  2950	2950   3 3321 ));
+DATA(insert (	3310  2950	2950   4 3322 ));
+DATA(insert (	3310  2950	2950  15 2963 ));
+/* bloom timestamp */
+DATA(insert (	3311  1114	1114   1 3319 ));
+DATA(insert (	3311  1114	1114   2 3320 ));
+DATA(insert (	3311  1114	1114   3 3321 ));
+DATA(insert (	3311  1114	1114   4 3322 ));
+DATA(insert (	3311  1114	1114  15 2039 ));
+/* bloom timestamptz */
+DATA(insert (	3312  1184	1184   1 3319 ));
+DATA(insert (	3312  1184	1184   2 3320 ));
+DATA(insert (	3312  1184	1184   3 3321 ));
+DATA(insert (	3312  1184	1184   4 3322 ));
+DATA(insert (	3312  1184	1184  15 2039 ));
+/* minmax multi int4 */
+DATA(insert (	3313    23	  23   1 3323 ));
+DATA(insert (	3313    23	  23   2 3326 ));
+DATA(insert (	3313    23	  23   3 3327 ));
+DATA(insert (	3313    23	  23   4 3328 ));
+DATA(insert (	3313    23	  23  11 3347 ));
+/* minmax multi int8 */
+DATA(insert (	3314    20	  20   1 3323 ));
+DATA(insert (	3314    20	  20   2 3326 ));
+DATA(insert (	3314    20	  20   3 3327 ));
+DATA(insert (	3314    20	  20   4 3328 ));
+DATA(insert (	3314    20	  20  11 3348 ));
+/* minmax multi float8 */
+DATA(insert (	3315   701	 701   1 3323 ));
+DATA(insert (	3315   701	 701   2 3326 ));
+DATA(insert (	3315   701	 701   3 3327 ));
+DATA(insert (	3315   701	 701   4 3328 ));
+DATA(insert (	3315   701	 701  11 3349 ));
+/* minmax multi date */
+DATA(insert (	3316  1082	1082   1 3323 ));
+DATA(insert (	3316  1082	1082   2 3326 ));
+DATA(insert (	3316  1082	1082   3 3327 ));
+DATA(insert (	3316  1082	1082   4 3328 ));
+DATA(insert (	3316  1082	1082  11 3350 ));
+/* minmax multi timestamp */
+DATA(insert (	3317  1114	1114   1 3323 ));
+DATA(insert (	3317  1114	1114   2 3326 ));
+DATA(insert (	3317  1114	1114   3 3327 ));
+DATA(insert (	3317  1114	1114   4 3328 ));
+DATA(insert (	3317  1114	1114  11 3351 ));
+/* minmax multi timestamptz */
+DATA(insert (	3318  1184	1184   1 3323 ));
+DATA(insert (	3318  1184	1184   2 3326 ));
+DATA(insert (	3318  1184	1184   3 3327 ));
+DATA(insert (	3318  1184	1184   4 3328 ));
+DATA(insert (	3318  1184	1184  11 3351 ));
 
 #endif   /* PG_AMPROC_H */
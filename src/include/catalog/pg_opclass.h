@@ -271,5 +271,18 @@ DATA(insert (	3580	pg_lsn_minmax_ops		PGNSP PGUID 4082  3220 t 3220 ));
 /* no brin opclass for enum, tsvector, tsquery, jsonb */
 DATA(insert (	3580	box_inclusion_ops		PGNSP PGUID 4104   603 t 603 ));
 /* no brin opclass for the geometric types except box */
+/* bloom and multi-range minmax opclasses, never the default */
+DATA(insert (	3580	int4_bloom_ops		PGNSP PGUID 3307    23 f 23 ));
+DATA(insert (	3580	int8_bloom_ops		PGNSP PGUID 3308    20 f 20 ));
+DATA(insert (	3580	text_bloom_ops		PGNSP PGUID 3309    25 f 25 ));
+DATA(insert (	3580	uuid_bloom_ops		PGNSP PGUID 3310  2950 f 2950 ));
+DATA(insert (	3580	timestamp_bloom_ops		PGNSP PGUID 3311  1114 f 1114 ));
+DATA(insert (	3580	timestamptz_bloom_ops		PGNSP PGUID 3312  1184 f 1184 ));
+DATA(insert (	3580	int4_minmax_multi_ops	PGNSP PGUID 3313    23 f 23 ));
+DATA(insert (	3580	int8_minmax_multi_ops	PGNSP PGUID 3314    20 f 20 ));
+DATA(insert (	3580	float8_minmax_multi_ops	PGNSP PGUID 3315   701 f 701 ));
+DATA(insert (	3580	date_minmax_multi_ops	PGNSP PGUID 3316  1082 f 1082 ));
+DATA(insert (	3580	timestamp_minmax_multi_ops	PGNSP PGUID 3317  1114 f 1114 ));
+DATA(insert (	3580	timestamptz_minmax_multi_ops	PGNSP PGUID 3318  1184 f 1184 ));
 
 #endif   /* PG_OPCLASS_H */
@@ -290,4 +290,20 @@ typedef FormData_pg_statistic *Form_pg_statistic;
  */
 #define STATISTIC_KIND_BOUNDS_HISTOGRAM  7
 
+/*
+ * A "dependency" slot appears in the statistics of the columns of a
+ * multi-column index, other than the first, that are preceded only by plain
+ * table columns (not expressions), when the index isn't partial.  Such a
+ * row describes the group of table columns that the index key starts with,
+ * up to and including this one, rather than the index column alone:
+ * stadistinct is the number of distinct combinations of their values,
+ * stanullfrac is the fraction of rows with a null in any of them, and
+ * stawidth is their total average width.  stanumbers[0] is the "degree" to
+ * which the values of the preceding columns determine the value of this
+ * one: the fraction of sample rows whose combination of values of the
+ * preceding columns always went with the same value of this column.
+ * staop is unused.
+ */
+#define STATISTIC_KIND_DEPENDENCY  8
+
 #endif   /* PG_STATISTIC_H */
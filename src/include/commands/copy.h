@@ -20,6 +20,7 @@
 
 /* CopyStateData is private in commands/copy.c */
 typedef struct CopyStateData *CopyState;
+typedef int (*copy_data_source_cb) (void *outbuf, int minread, int maxread);
 
 extern Oid DoCopy(const CopyStmt *stmt, const char *queryString,
 	   uint64 *processed);
@@ -27,12 +28,19 @@ extern Oid DoCopy(const CopyStmt *stmt, const char *queryString,
 extern void ProcessCopyOptions(CopyState cstate, bool is_from, List *options);
 extern CopyState BeginCopyFrom(Relation rel, const char *filename,
 			  bool is_program, List *attnamelist, List *options);
+extern CopyState BeginCopyFromCallback(Relation rel,
+					  copy_data_source_cb data_source_cb,
+					  List *attnamelist, List *options);
+extern CopyState BeginCopyFromReader(Relation rel,
+					copy_data_source_cb data_source_cb,
+					List *attnamelist, List *options);
 extern void EndCopyFrom(CopyState cstate);
 extern bool NextCopyFrom(CopyState cstate, ExprContext *econtext,
 			 Datum *values, bool *nulls, Oid *tupleOid);
 extern bool NextCopyFromRawFields(CopyState cstate,
 					  char ***fields, int *nfields);
 extern void CopyFromErrorCallback(void *arg);
+extern uint64 CopyFrom(CopyState cstate);
 
 extern DestReceiver *CreateCopyDestReceiver(void);
 
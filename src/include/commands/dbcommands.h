@@ -19,6 +19,9 @@
 #include "lib/stringinfo.h"
 #include "nodes/parsenodes.h"
 
+/* GUC variable */
+extern int	create_database_wal_log_limit;
+
 extern Oid	createdb(const CreatedbStmt *stmt);
 extern void dropdb(const char *dbname, bool missing_ok);
 extern ObjectAddress RenameDatabase(const char *oldname, const char *newname);
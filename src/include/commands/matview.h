@@ -15,6 +15,7 @@
 #define MATVIEW_H
 
 #include "catalog/objectaddress.h"
+#include "fmgr.h"
 #include "nodes/params.h"
 #include "nodes/parsenodes.h"
 #include "tcop/dest.h"
@@ -30,4 +31,9 @@ extern DestReceiver *CreateTransientRelDestReceiver(Oid oid);
 
 extern bool MatViewIncrementalMaintenanceIsEnabled(void);
 
+extern Query *PrepareIncrementalMatViewQuery(Query *query, List *colNames);
+extern void CreateIncrementalMatViewTriggers(Query *query, Oid matviewOid);
+
+extern Datum matview_incremental_maintenance(PG_FUNCTION_ARGS);
+
 #endif   /* MATVIEW_H */
@@ -55,5 +55,6 @@ extern TupleDesc FetchPreparedStatementResultDesc(PreparedStatement *stmt);
 extern List *FetchPreparedStatementTargetList(PreparedStatement *stmt);
 
 extern void DropAllPreparedStatements(void);
+extern bool HavePreparedStatements(void);
 
 #endif   /* PREPARE_H */
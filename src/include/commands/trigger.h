@@ -16,6 +16,7 @@
 #include "catalog/objectaddress.h"
 #include "nodes/execnodes.h"
 #include "nodes/parsenodes.h"
+#include "utils/tuplestore.h"
 
 /*
  * TriggerData is the node type that is passed as fmgr "context" info
@@ -37,6 +38,8 @@ typedef struct TriggerData
 	Trigger    *tg_trigger;
 	Buffer		tg_trigtuplebuf;
 	Buffer		tg_newtuplebuf;
+	Tuplestorestate *tg_oldtable;	/* OLD transition table, or NULL */
+	Tuplestorestate *tg_newtable;	/* NEW transition table, or NULL */
 } TriggerData;
 
 /*
@@ -202,6 +205,8 @@ extern bool RI_FKey_fk_upd_check_required(Trigger *trigger, Relation fk_rel,
 							  HeapTuple old_row, HeapTuple new_row);
 extern bool RI_Initial_Check(Trigger *trigger,
 				 Relation fk_rel, Relation pk_rel);
+extern void RI_FKey_flush_checks(void);
+extern void RI_FKey_discard_checks(void);
 
 /* result values for RI_FKey_trigger_type: */
 #define RI_TRIGGER_PK	1		/* is a trigger on the PK relation */
@@ -211,5 +216,6 @@ extern bool RI_Initial_Check(Trigger *trigger,
 extern int	RI_FKey_trigger_type(Oid tgfoid);
 
 extern Datum pg_trigger_depth(PG_FUNCTION_ARGS);
+extern Datum pg_transition_table(PG_FUNCTION_ARGS);
 
 #endif   /* TRIGGER_H */
@@ -148,6 +148,7 @@ typedef struct VacuumParams
 } VacuumParams;
 
 /* GUC parameters */
+extern bool analyze_full_ndistinct;
 extern PGDLLIMPORT int default_statistics_target;		/* PGDLLIMPORT for
 														 * PostGIS */
 extern int	vacuum_freeze_min_age;
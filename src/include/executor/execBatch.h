@@ -0,0 +1,79 @@
+/*-------------------------------------------------------------------------
+ *
+ * execBatch.h
+ *	  Batch-at-a-time evaluation of simple scan quals.
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * src/include/executor/execBatch.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef EXECBATCH_H
+#define EXECBATCH_H
+
+#include "nodes/execnodes.h"
+
+/* In-memory representation of a batched column's values */
+typedef enum BatchValueType
+{
+	BATCH_INT32,				/* int4, date */
+	BATCH_INT64,				/* int8, timestamp, timestamptz */
+	BATCH_FLOAT8				/* float8 */
+} BatchValueType;
+
+typedef enum BatchCompare
+{
+	BATCH_EQ,
+	BATCH_NE,
+	BATCH_LT,
+	BATCH_LE,
+	BATCH_GT,
+	BATCH_GE
+} BatchCompare;
+
+/*
+ * One column of a batch, holding the values of attribute attno for every
+ * tuple in the batch.  Entries for null values are zero; such tuples have
+ * already been rejected, since all batched operators are strict.
+ */
+typedef struct BatchColumn
+{
+	AttrNumber	attno;
+	BatchValueType type;
+	union
+	{
+		int32	   *i32;
+		int64	   *i64;
+		float8	   *f8;
+	}			values;
+} BatchColumn;
+
+/* A "column op constant" clause */
+typedef struct BatchQualClause
+{
+	int			column;			/* index into BatchQualState.columns */
+	BatchCompare cmp;
+	int64		intval;			/* constant, for integer columns */
+	float8		floatval;		/* constant, for BATCH_FLOAT8 columns */
+} BatchQualClause;
+
+typedef struct BatchQualState
+{
+	int			capacity;		/* maximum number of tuples per batch */
+	int			ncolumns;
+	BatchColumn *columns;
+	int			nclauses;
+	BatchQualClause *clauses;
+	AttrNumber	maxattno;		/* highest attno in columns */
+	bool	   *pass;			/* per-tuple result of the quals so far */
+	List	   *tupleQual;		/* same clauses, as ExprState list */
+} BatchQualState;
+
+extern BatchQualState *ExecInitBatchQual(List *qual, Index scanrelid,
+				  int capacity, PlanState *parent, List **residual);
+extern int ExecBatchQual(BatchQualState *bqstate, HeapTupleData *tuples,
+			  int ntuples, TupleTableSlot *slot, int *sel);
+
+#endif   /* EXECBATCH_H */
@@ -106,6 +106,7 @@ extern void ExecMarkPos(PlanState *node);
 extern void ExecRestrPos(PlanState *node);
 extern bool ExecSupportsMarkRestore(struct Path *pathnode);
 extern bool ExecSupportsBackwardScan(Plan *node);
+extern bool ExecSupportsRerun(Plan *node);
 extern bool ExecMaterializesOutput(NodeTag plantype);
 
 /*
@@ -133,6 +134,7 @@ extern bool execTuplesUnequal(TupleTableSlot *slot1,
 				  MemoryContext evalContext);
 extern FmgrInfo *execTuplesMatchPrepare(int numCols,
 					   Oid *eqOperators);
+extern void execHashFunctionInfo(Oid hashfn, FmgrInfo *finfo);
 extern void execTuplesHashPrepare(int numCols,
 					  Oid *eqOperators,
 					  FmgrInfo **eqFunctions,
@@ -150,6 +152,10 @@ extern TupleHashEntry FindTupleHashEntry(TupleHashTable hashtable,
 				   TupleTableSlot *slot,
 				   FmgrInfo *eqfunctions,
 				   FmgrInfo *hashfunctions);
+extern void RemoveTupleHashEntry(TupleHashTable hashtable,
+					 TupleTableSlot *slot);
+extern TupleHashEntry ScanTupleHashTable(TupleHashTable hashtable,
+				   TupleHashIterator *iter);
 
 /*
  * prototypes from functions in execJunk.c
@@ -183,6 +189,7 @@ extern void standard_ExecutorFinish(QueryDesc *queryDesc);
 extern void ExecutorEnd(QueryDesc *queryDesc);
 extern void standard_ExecutorEnd(QueryDesc *queryDesc);
 extern void ExecutorRewind(QueryDesc *queryDesc);
+extern void ExecutorRerun(QueryDesc *queryDesc, Snapshot snapshot);
 extern bool ExecCheckRTPerms(List *rangeTable, bool ereport_on_violation);
 extern void CheckValidResultRel(Relation resultRel, CmdType operation);
 extern void InitResultRelInfo(ResultRelInfo *resultRelInfo,
@@ -225,6 +232,7 @@ extern PlanState *ExecInitNode(Plan *node, EState *estate, int eflags);
 extern TupleTableSlot *ExecProcNode(PlanState *node);
 extern Node *MultiExecProcNode(PlanState *node);
 extern void ExecEndNode(PlanState *node);
+extern void ExecShutdownNode(PlanState *node);
 
 /*
  * prototypes from functions in execQual.c
@@ -307,6 +315,7 @@ extern void end_tup_output(TupOutputState *tstate);
  */
 extern EState *CreateExecutorState(void);
 extern void FreeExecutorState(EState *estate);
+extern void ExecInitRangeTable(EState *estate, List *rangeTable);
 extern ExprContext *CreateExprContext(EState *estate);
 extern ExprContext *CreateStandaloneExprContext(void);
 extern void FreeExprContext(ExprContext *econtext, bool isCommit);
@@ -317,6 +326,15 @@ extern void ReScanExprContext(ExprContext *econtext);
 
 extern ExprContext *MakePerTupleExprContext(EState *estate);
 
+/*
+ * Get the range table entry of an EState by its index, like rt_fetch but in
+ * constant time
+ */
+#define exec_rt_fetch(rangetblidx, estate) \
+	(AssertMacro((rangetblidx) > 0 && \
+				 (rangetblidx) <= (estate)->es_range_table_size), \
+	 (estate)->es_range_table_array[(rangetblidx) - 1])
+
 /* Get an EState's per-output-tuple exprcontext, making it if first use */
 #define GetPerTupleExprContext(estate) \
 	((estate)->es_per_tuple_exprcontext ? \
@@ -353,6 +371,9 @@ extern bool ExecRelationIsTargetRelation(EState *estate, Index scanrelid);
 extern Relation ExecOpenScanRelation(EState *estate, Index scanrelid, int eflags);
 extern void ExecCloseScanRelation(Relation scanrel);
 
+extern List *ExecPruneSubplans(EState *estate, List *subplans,
+				  List *prunequals, List *pruneconstrs);
+
 extern void RegisterExprContextCallback(ExprContext *econtext,
 							ExprContextCallbackFunction function,
 							Datum arg);
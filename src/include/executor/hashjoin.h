@@ -15,7 +15,9 @@
 #define HASHJOIN_H
 
 #include "nodes/execnodes.h"
+#include "port/atomics.h"
 #include "storage/buffile.h"
+#include "storage/spin.h"
 
 /* ----------------------------------------------------------------
  *				hash-join hash table structures
@@ -54,12 +56,20 @@
  * inner batch file.  Subsequently, while reading either inner or outer batch
  * files, we might find tuples that no longer belong to the current batch;
  * if so, we just dump them out to the correct batch file.
+ *
+ * When a parallel-aware Hash node runs under a Gather, the hash table can
+ * instead live in the parallel query's dynamic shared memory segment, where
+ * all participants insert into it concurrently and then probe it; see the
+ * SharedHashJoinTableData comments below.  A shared table never has more
+ * than one batch.
  * ----------------------------------------------------------------
  */
 
 /* these are in nodes/execnodes.h: */
 /* typedef struct HashJoinTupleData *HashJoinTuple; */
 /* typedef struct HashJoinTableData *HashJoinTable; */
+/* typedef struct SharedHashJoinTupleData *SharedHashJoinTuple; */
+/* typedef struct SharedHashJoinTableData *SharedHashJoinTable; */
 
 typedef struct HashJoinTupleData
 {
@@ -68,6 +78,30 @@ typedef struct HashJoinTupleData
 	/* Tuple data, in MinimalTuple format, follows on a MAXALIGN boundary */
 }	HashJoinTupleData;
 
+/*
+ * Each bucket of the in-memory hash table holds the head of its list of
+ * tuples, plus a summary of their hash codes: for each tuple added to the
+ * list, bit HJ_HASH_TAG(hashvalue) is set in the bucket's tags.  A probe
+ * whose tag bit isn't set can tell that there's no match without touching
+ * any tuple, which saves a cache miss for most outer tuples that don't
+ * join.  Tags are only cleared when the whole bucket array is rebuilt, so a
+ * tuple leaving the list may leave a stale bit behind, which just costs an
+ * unnecessary walk of the list.
+ *
+ * The tag is computed from the top bits of a multiplicative hash of the hash
+ * code, so that it depends on all of its bits and not just those that also
+ * determine the bucket and batch numbers (which are the same for all tuples
+ * in the list).
+ */
+typedef struct HashJoinBucketData
+{
+	struct HashJoinTupleData *tuples;	/* head of list of tuples */
+	uint32		tags;			/* tag bits of the tuples in the list */
+}	HashJoinBucketData;
+
+#define HJ_HASH_TAG(hashvalue) \
+	((uint32) 1 << (((uint32) (hashvalue) * 0x9E3779B1U) >> 27))
+
 #define HJTUPLE_OVERHEAD  MAXALIGN(sizeof(HashJoinTupleData))
 #define HJTUPLE_MINTUPLE(hjtup)  \
 	((MinimalTuple) ((char *) (hjtup) + HJTUPLE_OVERHEAD))
@@ -123,6 +157,59 @@ typedef struct HashMemoryChunkData *HashMemoryChunk;
 #define HASH_CHUNK_SIZE			(32 * 1024L)
 #define HASH_CHUNK_THRESHOLD	(HASH_CHUNK_SIZE / 4)
 
+/*
+ * A shared hash table is laid out as one SharedHashJoinTableData header,
+ * followed by its bucket array and then by an "arena" from which the tuples
+ * are allocated, all in a single chunk of the parallel query's DSM segment.
+ * Because that segment may be mapped at a different address in each process,
+ * tuples are linked by their offset from the start of the arena, counted in
+ * units of MAXIMUM_ALIGNOF bytes; zero means end of chain, so the first unit
+ * of the arena is never handed out.  Bucket heads are updated with
+ * compare-and-swap, so participants can insert without any lock; only the
+ * carving of arena space into chunks takes the spinlock.
+ *
+ * All participants that start building register themselves, and nobody
+ * probes until the last of them has finished (build_done).  If the arena
+ * fills up, "overflow" is set and every participant falls back to building a
+ * private hash table of its own instead.
+ */
+typedef struct SharedHashJoinTupleData
+{
+	uint32		next;			/* offset of next tuple in same bucket */
+	uint32		hashvalue;		/* tuple's hash code */
+	/* Tuple data, in MinimalTuple format, follows on a MAXALIGN boundary */
+}	SharedHashJoinTupleData;
+
+#define SHJTUPLE_OVERHEAD  MAXALIGN(sizeof(SharedHashJoinTupleData))
+#define SHJTUPLE_MINTUPLE(shjtup)  \
+	((MinimalTuple) ((char *) (shjtup) + SHJTUPLE_OVERHEAD))
+
+typedef struct SharedHashJoinTableData
+{
+	slock_t		mutex;			/* protects the fields below */
+	int			nbuckets;		/* # buckets (a power of 2) */
+	int			log2_nbuckets;	/* its log2 */
+	Size		buckets_offset; /* start of bucket array within this chunk */
+	Size		arena_offset;	/* start of tuple arena within this chunk */
+	Size		arena_size;		/* size of tuple arena, in bytes */
+	Size		arena_used;		/* bytes of arena handed out so far */
+	double		totalTuples;	/* # tuples inserted by all participants */
+	bool		build_done;		/* has the table been completely built? */
+	bool		overflow;		/* did we run out of arena space? */
+	int			nbuilding;		/* # participants still building */
+	int			maxparticipants;	/* size of the builders[] array */
+	int			nbuilders;		/* # entries used in builders[] */
+	int			builders[FLEXIBLE_ARRAY_MEMBER];	/* pgprocnos to wake */
+}	SharedHashJoinTableData;
+
+#define SharedHashJoinBuckets(shared) \
+	((pg_atomic_uint32 *) ((char *) (shared) + (shared)->buckets_offset))
+#define SharedHashJoinArena(shared) \
+	((char *) (shared) + (shared)->arena_offset)
+#define SharedHashJoinTupleAt(shared, off) \
+	((SharedHashJoinTuple) (SharedHashJoinArena(shared) + \
+							(Size) (off) * MAXIMUM_ALIGNOF))
+
 typedef struct HashJoinTableData
 {
 	int			nbuckets;		/* # buckets in the in-memory hash table */
@@ -133,8 +220,8 @@ typedef struct HashJoinTableData
 	int			nbuckets_optimal;		/* optimal # buckets (per batch) */
 	int			log2_nbuckets_optimal;	/* same as log2_nbuckets optimal */
 
-	/* buckets[i] is head of list of tuples in i'th in-memory bucket */
-	struct HashJoinTupleData **buckets;
+	/* buckets[i] heads the list of tuples in i'th in-memory bucket */
+	HashJoinBucketData *buckets;
 	/* buckets array is per-batch storage, as are all the tuples */
 
 	bool		keepNulls;		/* true to store unmatchable NULL tuples */
@@ -186,6 +273,14 @@ typedef struct HashJoinTableData
 
 	/* used for dense allocation of tuples (into linked chunks) */
 	HashMemoryChunk chunks;		/* one list for the whole batch */
+
+	/* these are used only when the hash table lives in shared memory */
+	SharedHashJoinTable shared; /* shared control block, or NULL */
+	char	   *sharedChunk;	/* next free byte in our current arena chunk */
+	Size		sharedChunkFree;	/* bytes left in that chunk */
+
+	/* filter of inner hash values for the outer scan, or NULL */
+	struct bloom_filter *bloomfilter;
 }	HashJoinTableData;
 
 #endif   /* HASHJOIN_H */
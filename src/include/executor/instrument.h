@@ -14,8 +14,17 @@
 #define INSTRUMENT_H
 
 #include "portability/instr_time.h"
+#include "storage/relfilenode.h"
 
 
+/*
+ * With track_io_timing, the latency of each read and write is counted in a
+ * histogram.  The buckets are under 10us, under 100us, under 1ms, under 10ms,
+ * under 100ms and the rest; reads in the first bucket or two are usually
+ * served from the kernel's page cache rather than from the disk.
+ */
+#define IO_LATENCY_BUCKETS	6
+
 typedef struct BufferUsage
 {
 	long		shared_blks_hit;	/* # of shared buffer hits */
@@ -30,29 +39,60 @@ typedef struct BufferUsage
 	long		temp_blks_written;		/* # of temp blocks written */
 	instr_time	blk_read_time;	/* time spent reading */
 	instr_time	blk_write_time; /* time spent writing */
+	instr_time	temp_blk_read_time;		/* time spent reading temp blocks */
+	instr_time	temp_blk_write_time;	/* time spent writing temp blocks */
+	long		blk_read_hist[IO_LATENCY_BUCKETS];	/* reads by latency */
+	long		blk_write_hist[IO_LATENCY_BUCKETS];		/* writes by latency */
 } BufferUsage;
 
+typedef struct WalUsage
+{
+	long		wal_records;	/* # of WAL records produced */
+	long		wal_fpi;		/* # of WAL full page images produced */
+	uint64		wal_bytes;		/* size of WAL records produced */
+} WalUsage;
+
+/* Buffer usage of one relation fork, see InstrStartRelBufferUsage */
+typedef struct RelBufferUsage
+{
+	RelFileNode rnode;
+	ForkNumber	forknum;
+	long		blks_hit;		/* # of buffer hits */
+	long		blks_read;		/* # of blocks read */
+	instr_time	blk_read_time;	/* time spent reading */
+} RelBufferUsage;
+
 /* Flag bits included in InstrAlloc's instrument_options bitmask */
 typedef enum InstrumentOption
 {
 	INSTRUMENT_TIMER = 1 << 0,	/* needs timer (and row counts) */
 	INSTRUMENT_BUFFERS = 1 << 1,	/* needs buffer usage */
 	INSTRUMENT_ROWS = 1 << 2,	/* needs row count */
+	INSTRUMENT_WAL = 1 << 3,	/* needs WAL usage */
 	INSTRUMENT_ALL = PG_INT32_MAX
 } InstrumentOption;
 
+/*
+ * Node timing reads the clock twice for every tuple of every node, so
+ * starttime and counter are kept in ticks of the cheapest clock available:
+ * the CPU's time-stamp counter where it is known to run at a constant rate,
+ * otherwise microseconds from INSTR_TIME_SET_CURRENT.  Only instrument.c
+ * needs to know which.
+ */
 typedef struct Instrumentation
 {
 	/* Parameters set at node creation: */
 	bool		need_timer;		/* TRUE if we need timer data */
 	bool		need_bufusage;	/* TRUE if we need buffer usage data */
+	bool		need_walusage;	/* TRUE if we need WAL usage data */
 	/* Info about current plan cycle: */
 	bool		running;		/* TRUE if we've completed first tuple */
-	instr_time	starttime;		/* Start time of current iteration of node */
-	instr_time	counter;		/* Accumulated runtime for this node */
+	uint64		starttime;		/* Start time of current iteration of node */
+	uint64		counter;		/* Accumulated runtime for this node */
 	double		firsttuple;		/* Time for first tuple of this cycle */
 	double		tuplecount;		/* Tuples emitted so far this cycle */
 	BufferUsage bufusage_start; /* Buffer usage at start */
+	WalUsage	walusage_start; /* WAL usage at start */
 	/* Accumulated statistics across all completed cycles: */
 	double		startup;		/* Total startup time (in seconds) */
 	double		total;			/* Total total time (in seconds) */
@@ -61,13 +101,25 @@ typedef struct Instrumentation
 	double		nfiltered1;		/* # tuples removed by scanqual or joinqual */
 	double		nfiltered2;		/* # tuples removed by "other" quals */
 	BufferUsage bufusage;		/* Total buffer usage */
+	WalUsage	walusage;		/* Total WAL usage */
 } Instrumentation;
 
 extern PGDLLIMPORT BufferUsage pgBufferUsage;
+extern PGDLLIMPORT WalUsage pgWalUsage;
+extern PGDLLIMPORT bool pgRelBufferUsageActive;
 
 extern Instrumentation *InstrAlloc(int n, int instrument_options);
 extern void InstrStartNode(Instrumentation *instr);
 extern void InstrStopNode(Instrumentation *instr, double nTuples);
 extern void InstrEndLoop(Instrumentation *instr);
+extern int	InstrIOLatencyBucket(instr_time io_time);
+extern const char *InstrIOLatencyBucketName(int bucket);
+extern void WalUsageAccumDiff(WalUsage *dst, const WalUsage *add,
+				  const WalUsage *sub);
+
+extern bool InstrStartRelBufferUsage(void);
+extern RelBufferUsage *InstrEndRelBufferUsage(int *nentries);
+extern void InstrCountRelBuffers(RelFileNode rnode, ForkNumber forknum,
+					 long hits, long reads, instr_time *io_time);
 
 #endif   /* INSTRUMENT_H */
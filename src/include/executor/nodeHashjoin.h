@@ -17,12 +17,22 @@
 #include "nodes/execnodes.h"
 #include "storage/buffile.h"
 
+/* GUC parameter */
+extern bool enable_hashjoin_filter;
+
 extern HashJoinState *ExecInitHashJoin(HashJoin *node, EState *estate, int eflags);
+extern HashJoinState *ExecInitHashJoinOverStates(HashJoin *node,
+						   EState *estate, int eflags,
+						   PlanState *outerState, PlanState *innerState);
 extern TupleTableSlot *ExecHashJoin(HashJoinState *node);
 extern void ExecEndHashJoin(HashJoinState *node);
+extern void ExecEndHashJoinOverStates(HashJoinState *node);
 extern void ExecReScanHashJoin(HashJoinState *node);
 
 extern void ExecHashJoinSaveTuple(MinimalTuple tuple, uint32 hashvalue,
 					  BufFile **fileptr);
 
+extern bool ExecHashJoinFilterTuple(JoinFilterState *jfstate,
+						TupleTableSlot *slot);
+
 #endif   /* NODEHASHJOIN_H */
@@ -16,6 +16,9 @@
 
 #include "nodes/execnodes.h"
 
+/* GUC variable */
+extern bool enable_adaptive_join;
+
 extern NestLoopState *ExecInitNestLoop(NestLoop *node, EState *estate, int eflags);
 extern TupleTableSlot *ExecNestLoop(NestLoopState *node);
 extern void ExecEndNestLoop(NestLoopState *node);
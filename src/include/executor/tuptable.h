@@ -107,7 +107,10 @@
  * extraction to treat the case identically to regular physical tuples.
  *
  * tts_slow/tts_off are saved state for slot_deform_tuple, and should not
- * be touched by any other code.
+ * be touched by any other code.  tts_nfixed is the number of leading
+ * attributes of the descriptor that are fixed-width, and so lie at the same
+ * offset in every tuple that has no nulls among them; it lets
+ * slot_deform_tuple fetch them without any per-attribute bookkeeping.
  *----------
  */
 typedef struct TupleTableSlot
@@ -127,6 +130,7 @@ typedef struct TupleTableSlot
 	MinimalTuple tts_mintuple;	/* minimal tuple, or NULL if none */
 	HeapTupleData tts_minhdr;	/* workspace for minimal-tuple-only case */
 	long		tts_off;		/* saved state for slot_deform_tuple */
+	int			tts_nfixed;		/* # of leading fixed-width attributes */
 } TupleTableSlot;
 
 #define TTS_HAS_PHYSICAL_TUPLE(slot)  \
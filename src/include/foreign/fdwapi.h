@@ -12,6 +12,7 @@
 #ifndef FDWAPI_H
 #define FDWAPI_H
 
+#include "access/parallel.h"
 #include "nodes/execnodes.h"
 #include "nodes/relation.h"
 
@@ -87,6 +88,31 @@ typedef TupleTableSlot *(*ExecForeignDelete_function) (EState *estate,
 typedef void (*EndForeignModify_function) (EState *estate,
 													   ResultRelInfo *rinfo);
 
+typedef int (*GetForeignModifyBatchSize_function) (ResultRelInfo *rinfo);
+
+typedef bool (*PlanDirectModify_function) (PlannerInfo *root,
+													   ModifyTable *plan,
+													   Index resultRelation,
+													   int subplan_index);
+
+typedef void (*BeginDirectModify_function) (ForeignScanState *node,
+														int eflags);
+
+typedef TupleTableSlot *(*IterateDirectModify_function) (ForeignScanState *node);
+
+typedef void (*EndDirectModify_function) (ForeignScanState *node);
+
+typedef void (*BeginForeignInsert_function) (EState *estate,
+														 ResultRelInfo *rinfo);
+
+typedef int (*ExecForeignBatchInsert_function) (EState *estate,
+														ResultRelInfo *rinfo,
+													  TupleTableSlot **slots,
+															int nslots);
+
+typedef void (*EndForeignInsert_function) (EState *estate,
+													   ResultRelInfo *rinfo);
+
 typedef int (*IsForeignRelUpdatable_function) (Relation rel);
 
 typedef RowMarkType (*GetForeignRowMarkType_function) (RangeTblEntry *rte,
@@ -106,6 +132,9 @@ typedef void (*ExplainForeignModify_function) (ModifyTableState *mtstate,
 														   int subplan_index,
 													struct ExplainState *es);
 
+typedef void (*ExplainDirectModify_function) (ForeignScanState *node,
+													struct ExplainState *es);
+
 typedef int (*AcquireSampleRowsFunc) (Relation relation, int elevel,
 											   HeapTuple *rows, int targrows,
 												  double *totalrows,
@@ -118,6 +147,31 @@ typedef bool (*AnalyzeForeignTable_function) (Relation relation,
 typedef List *(*ImportForeignSchema_function) (ImportForeignSchemaStmt *stmt,
 														   Oid serverOid);
 
+typedef bool (*IsForeignScanAsyncCapable_function) (ForeignScanState *node);
+
+typedef bool (*ForeignAsyncReady_function) (ForeignScanState *node,
+														pgsocket *waitsock);
+
+typedef bool (*IsForeignScanParallelSafe_function) (PlannerInfo *root,
+															 RelOptInfo *rel,
+														 RangeTblEntry *rte);
+
+typedef Size (*EstimateDSMForeignScan_function) (ForeignScanState *node,
+													  ParallelContext *pcxt);
+
+typedef void (*InitializeDSMForeignScan_function) (ForeignScanState *node,
+													   ParallelContext *pcxt,
+														   void *coordinate);
+
+typedef void (*InitializeWorkerForeignScan_function) (ForeignScanState *node,
+																shm_toc *toc,
+														   void *coordinate);
+
+typedef ForeignScan *(*GetForeignUpperPlan_function) (PlannerInfo *root,
+														   RelOptInfo *input_rel,
+														   List *tlist,
+														   double num_groups);
+
 /*
  * FdwRoutine is the struct returned by a foreign-data wrapper's handler
  * function.  It provides pointers to the callback functions needed by the
@@ -158,6 +212,16 @@ typedef struct FdwRoutine
 	ExecForeignDelete_function ExecForeignDelete;
 	EndForeignModify_function EndForeignModify;
 	IsForeignRelUpdatable_function IsForeignRelUpdatable;
+	GetForeignModifyBatchSize_function GetForeignModifyBatchSize;
+	PlanDirectModify_function PlanDirectModify;
+	BeginDirectModify_function BeginDirectModify;
+	IterateDirectModify_function IterateDirectModify;
+	EndDirectModify_function EndDirectModify;
+
+	/* Functions for COPY FROM into foreign tables */
+	BeginForeignInsert_function BeginForeignInsert;
+	ExecForeignBatchInsert_function ExecForeignBatchInsert;
+	EndForeignInsert_function EndForeignInsert;
 
 	/* Functions for SELECT FOR UPDATE/SHARE row locking */
 	GetForeignRowMarkType_function GetForeignRowMarkType;
@@ -166,12 +230,26 @@ typedef struct FdwRoutine
 	/* Support functions for EXPLAIN */
 	ExplainForeignScan_function ExplainForeignScan;
 	ExplainForeignModify_function ExplainForeignModify;
+	ExplainDirectModify_function ExplainDirectModify;
 
 	/* Support functions for ANALYZE */
 	AnalyzeForeignTable_function AnalyzeForeignTable;
 
 	/* Support functions for IMPORT FOREIGN SCHEMA */
 	ImportForeignSchema_function ImportForeignSchema;
+
+	/* Functions for asynchronous execution under Append */
+	IsForeignScanAsyncCapable_function IsForeignScanAsyncCapable;
+	ForeignAsyncReady_function ForeignAsyncReady;
+
+	/* Functions for parallel execution under Gather */
+	IsForeignScanParallelSafe_function IsForeignScanParallelSafe;
+	EstimateDSMForeignScan_function EstimateDSMForeignScan;
+	InitializeDSMForeignScan_function InitializeDSMForeignScan;
+	InitializeWorkerForeignScan_function InitializeWorkerForeignScan;
+
+	/* Functions for remote aggregation */
+	GetForeignUpperPlan_function GetForeignUpperPlan;
 } FdwRoutine;
 
 
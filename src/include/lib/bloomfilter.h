@@ -0,0 +1,39 @@
+/*
+ * bloomfilter.h
+ *
+ * A simple Bloom filter of 32-bit hash values
+ *
+ * Portions Copyright (c) 2015, PostgreSQL Global Development Group
+ *
+ * src/include/lib/bloomfilter.h
+ */
+
+#ifndef BLOOMFILTER_H
+#define BLOOMFILTER_H
+
+/*
+ * A Bloom filter answers whether an element might have been added to it,
+ * with no false negatives and a false positive rate that depends on the
+ * number of bits per element.  Callers add and test hash values they have
+ * already computed for their elements, as for hyperloglog.h.
+ *
+ * bloom_filter
+ *
+ *		k_hash_funcs	number of bits set for each element
+ *		bitset_mask		number of bits in the bitset, less one
+ *		bitset			array of bits, a power of two in size
+ */
+typedef struct bloom_filter
+{
+	int			k_hash_funcs;
+	uint32		bitset_mask;
+	unsigned char bitset[FLEXIBLE_ARRAY_MEMBER];
+} bloom_filter;
+
+extern bloom_filter *bloom_create(double total_elems, int bloom_work_mem);
+extern void bloom_free(bloom_filter *filter);
+extern void bloom_add_hash(bloom_filter *filter, uint32 hash);
+extern bool bloom_lacks_hash(bloom_filter *filter, uint32 hash);
+extern double bloom_prop_bits_set(bloom_filter *filter);
+
+#endif   /* BLOOMFILTER_H */
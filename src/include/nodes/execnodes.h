@@ -17,6 +17,7 @@
 #include "access/genam.h"
 #include "access/heapam.h"
 #include "executor/instrument.h"
+#include "lib/ilist.h"
 #include "lib/pairingheap.h"
 #include "nodes/params.h"
 #include "nodes/plannodes.h"
@@ -33,7 +34,9 @@
  *		entries for a particular index.  Used for both index_build and
  *		retail creation of index entries.
  *
- *		NumIndexAttrs		number of columns in this index
+ *		NumIndexAttrs		total number of columns in this index
+ *		NumIndexKeyAttrs	number of key columns in index; the rest, if
+ *							any, are non-key INCLUDE columns
  *		KeyAttrNumbers		underlying-rel attribute numbers used as keys
  *							(zeroes indicate expressions)
  *		Expressions			expr trees for expression entries, or NIL if none
@@ -59,6 +62,7 @@ typedef struct IndexInfo
 {
 	NodeTag		type;
 	int			ii_NumIndexAttrs;
+	int			ii_NumIndexKeyAttrs;
 	AttrNumber	ii_KeyAttrNumbers[INDEX_MAX_KEYS];
 	List	   *ii_Expressions; /* list of Expr */
 	List	   *ii_ExpressionsState;	/* list of ExprState */
@@ -151,6 +155,14 @@ typedef struct ExprContext
 
 	/* Functions to call back when ExprContext is shut down or rescanned */
 	ExprContext_CB *ecxt_callbacks;
+
+	/*
+	 * Expanded toast values made for Vars that are referenced repeatedly,
+	 * so that each toasted value is detoasted only once per tuple.  They
+	 * live in ecxt_per_tuple_memory, and the list is emptied when that's
+	 * reset.
+	 */
+	List	   *ecxt_toast_values;
 } ExprContext;
 
 /*
@@ -311,6 +323,10 @@ typedef struct JunkFilter
  *		TrigInstrument			optional runtime measurements for triggers
  *		FdwRoutine				FDW callback functions, if foreign table
  *		FdwState				available to save private state of FDW
+ *		usesFdwDirectModify		true when modifying foreign table directly
+ *		BatchSize				max # of rows the FDW inserts at a time
+ *		NumSlots				# of rows waiting in Slots to be inserted
+ *		Slots					rows to be inserted by the FDW, if batching
  *		WithCheckOptions		list of WithCheckOption's to be checked
  *		WithCheckOptionExprs	list of WithCheckOption expr states
  *		ConstraintExprs			array of constraint-checking expr states
@@ -334,6 +350,10 @@ typedef struct ResultRelInfo
 	Instrumentation *ri_TrigInstrument;
 	struct FdwRoutine *ri_FdwRoutine;
 	void	   *ri_FdwState;
+	bool		ri_usesFdwDirectModify;
+	int			ri_BatchSize;
+	int			ri_NumSlots;
+	TupleTableSlot **ri_Slots;
 	List	   *ri_WithCheckOptions;
 	List	   *ri_WithCheckOptionExprs;
 	List	  **ri_ConstraintExprs;
@@ -358,6 +378,8 @@ typedef struct EState
 	Snapshot	es_snapshot;	/* time qual to use */
 	Snapshot	es_crosscheck_snapshot; /* crosscheck time qual for RI */
 	List	   *es_range_table; /* List of RangeTblEntry */
+	struct RangeTblEntry **es_range_table_array;	/* equivalent array */
+	Index		es_range_table_size;	/* size of the range table arrays */
 	PlannedStmt *es_plannedstmt;	/* link to top of plan tree */
 
 	JunkFilter *es_junkFilter;	/* top-level junk filter, if any */
@@ -414,7 +436,7 @@ typedef struct EState
 	 * return, or NULL if nothing to return; es_epqTupleSet[] is true if a
 	 * particular array entry is valid; and es_epqScanDone[] is state to
 	 * remember if the tuple has been returned already.  Arrays are of size
-	 * list_length(es_range_table) and are indexed by scan node scanrelid - 1.
+	 * es_range_table_size and are indexed by scan node scanrelid - 1.
 	 */
 	HeapTuple  *es_epqTuple;	/* array of EPQ substitute tuples */
 	bool	   *es_epqTupleSet; /* true if EPQ tuple is provided */
@@ -501,9 +523,30 @@ typedef struct TupleHashEntryData
 	/* there may be additional data beyond the end of this struct */
 } TupleHashEntryData;			/* VARIABLE LENGTH STRUCT */
 
+/*
+ * The hash table proper is an array of these buckets (see lib/simplehash.h).
+ * The entries are allocated separately, so that pointers to them stay valid
+ * while the array is rearranged.
+ */
+typedef struct TupleHashBucketData
+{
+	MinimalTuple firstTuple;	/* same as entry->firstTuple */
+	TupleHashEntry entry;		/* the entry itself */
+	uint32		hash;			/* hash value of firstTuple */
+	char		status;			/* hash status */
+} TupleHashBucketData;
+
+/* define parameters necessary to generate the tuple hash table interface */
+#define SH_PREFIX tuplehash
+#define SH_ELEMENT_TYPE TupleHashBucketData
+#define SH_KEY_TYPE MinimalTuple
+#define SH_SCOPE extern
+#define SH_DECLARE
+#include "lib/simplehash.h"
+
 typedef struct TupleHashTableData
 {
-	HTAB	   *hashtab;		/* underlying dynahash table */
+	tuplehash_hash *hashtab;	/* underlying hash table */
 	int			numCols;		/* number of columns in lookup key */
 	AttrNumber *keyColIdx;		/* attr numbers of key columns */
 	FmgrInfo   *tab_hash_funcs; /* hash functions for table datatype(s) */
@@ -518,24 +561,23 @@ typedef struct TupleHashTableData
 	FmgrInfo   *cur_eq_funcs;	/* equality functions for input vs. table */
 }	TupleHashTableData;
 
-typedef HASH_SEQ_STATUS TupleHashIterator;
+typedef tuplehash_iterator TupleHashIterator;
 
 /*
- * Use InitTupleHashIterator/TermTupleHashIterator for a read/write scan.
- * Use ResetTupleHashIterator if the table can be frozen (in this case no
- * explicit scan termination is needed).
+ * Use InitTupleHashIterator/TermTupleHashIterator for a read/write scan;
+ * the entry last returned may be removed during the scan, but no new
+ * entries may be added.  Use ResetTupleHashIterator to restart a scan.
+ * ScanTupleHashTable (see execGrouping.c) returns NULL at the end of the
+ * scan.
  */
 #define InitTupleHashIterator(htable, iter) \
-	hash_seq_init(iter, (htable)->hashtab)
+	tuplehash_start_iterate((htable)->hashtab, iter)
 #define TermTupleHashIterator(iter) \
-	hash_seq_term(iter)
+	((void) 0)
 #define ResetTupleHashIterator(htable, iter) \
-	do { \
-		hash_freeze((htable)->hashtab); \
-		hash_seq_init(iter, (htable)->hashtab); \
-	} while (0)
-#define ScanTupleHashTable(iter) \
-	((TupleHashEntry) hash_seq_search(iter))
+	InitTupleHashIterator(htable, iter)
+#define TupleHashTableEntries(htable) \
+	((htable)->hashtab->members)
 
 
 /* ----------------------------------------------------------------
@@ -746,6 +788,8 @@ typedef struct ScalarArrayOpExprState
 	int16		typlen;
 	bool		typbyval;
 	char		typalign;
+	/* Hash table of a constant array's elements, if evaluated by hashing */
+	struct ScalarArrayOpHashTable *elements_tab;
 } ScalarArrayOpExprState;
 
 /* ----------------
@@ -1143,6 +1187,18 @@ typedef struct ModifyTableState
  *
  *		nplans			how many plans are in the array
  *		whichplan		which plan is being executed (0 .. n-1)
+ *
+ *		Foreign scans whose FDW supports it are run asynchronously: the
+ *		Append returns tuples from whichever of them has some ready, and
+ *		runs the other subplans one after another meanwhile.
+ *
+ *		async			which plans are run asynchronously, or NULL if none
+ *		nasync			how many plans are run asynchronously
+ *		asyncdone		which of those have returned all their tuples
+ *		nasyncremaining how many of those haven't
+ *		waitsocks		socket each of those is waiting on, if any
+ *		nextasync		which of those to ask for a tuple first
+ *		syncsincepoll	tuples returned by other plans since last poll
  * ----------------
  */
 typedef struct AppendState
@@ -1151,6 +1207,13 @@ typedef struct AppendState
 	PlanState **appendplans;	/* array of PlanStates for my inputs */
 	int			as_nplans;
 	int			as_whichplan;
+	bool	   *as_async;
+	int			as_nasync;
+	bool	   *as_asyncdone;
+	int			as_nasyncremaining;
+	pgsocket   *as_waitsocks;
+	int			as_nextasync;
+	int			as_syncsincepoll;
 } AppendState;
 
 /* ----------------
@@ -1185,6 +1248,10 @@ typedef struct MergeAppendState
  *		intermediate_empty	T if intermediate_table is currently empty
  *		working_table		working table (to be scanned by recursive term)
  *		intermediate_table	current recursive output (next generation of WT)
+ *
+ *		If the hash table of tuples already seen outgrows work_mem, it is
+ *		partitioned into nbatch batches kept in temporary files; see
+ *		nodeRecursiveunion.c.
  * ----------------
  */
 typedef struct RecursiveUnionState
@@ -1200,6 +1267,16 @@ typedef struct RecursiveUnionState
 	MemoryContext tempContext;	/* short-term context for comparisons */
 	TupleHashTable hashtable;	/* hash table for tuples already seen */
 	MemoryContext tableContext; /* memory context containing hash table */
+	Size		hashMemUsed;	/* approx. memory used by the hash table */
+	long		numGroups;		/* estimated number of distinct tuples */
+	int			nbatch;			/* number of batches, or 0 if not spilled */
+	int			curbatch;		/* batch being deduplicated, or -1 */
+	bool		batchLoaded;	/* seen tuples of curbatch are in hashtable? */
+	struct BufFile **seenFiles; /* per-batch tuples already seen */
+	struct BufFile **newFiles;	/* per-batch tuples of the current step */
+	Size	   *seenSpace;		/* space taken by each of seenFiles */
+	Size	   *newSpace;		/* space taken by each of newFiles */
+	TupleTableSlot *spillSlot;	/* for tuples read back from batch files */
 } RecursiveUnionState;
 
 /* ----------------
@@ -1241,6 +1318,7 @@ typedef struct BitmapOrState
  *		currentRelation    relation being scanned (NULL if none)
  *		currentScanDesc    current scan descriptor for scan (NULL if none)
  *		ScanTupleSlot	   pointer to slot in tuple table holding scan tuple
+ *		JoinFilter		   filter pushed down by a hash join above (or NULL)
  * ----------------
  */
 typedef struct ScanState
@@ -1249,13 +1327,42 @@ typedef struct ScanState
 	Relation	ss_currentRelation;
 	HeapScanDesc ss_currentScanDesc;
 	TupleTableSlot *ss_ScanTupleSlot;
+	struct JoinFilterState *ss_JoinFilter;
 } ScanState;
 
-/*
- * SeqScan uses a bare ScanState as its state node, since it needs
- * no additional fields.
+/* ----------------
+ *	 SeqScanState information
+ *
+ *		A SeqScan whose quals include simple comparisons of fixed-width
+ *		columns against constants evaluates those quals a page at a time;
+ *		see execBatch.c.  The remaining fields track the current batch.
+ *
+ *		batchQual		   batch-evaluated quals, or NULL if none
+ *		batchSlot		   work slot used to deform tuples of the batch
+ *		batchTuples		   tuples of the current batch
+ *		batchSel		   indexes into batchTuples of tuples passing the quals
+ *		batchNumSel		   number of valid entries in batchSel
+ *		batchNext		   next entry of batchSel to return
+ *		batchBuffer		   buffer holding batchTuples, pinned by us
+ *		batchPending	   tuple already read that belongs to the next batch
+ *		batchHavePending   true if batchPending is valid
+ *		batchDone		   true once the heap scan has run out of tuples
+ * ----------------
  */
-typedef ScanState SeqScanState;
+typedef struct SeqScanState
+{
+	ScanState	ss;				/* its first field is NodeTag */
+	struct BatchQualState *batchQual;
+	TupleTableSlot *batchSlot;
+	HeapTupleData *batchTuples;
+	int		   *batchSel;
+	int			batchNumSel;
+	int			batchNext;
+	Buffer		batchBuffer;
+	HeapTupleData batchPending;
+	bool		batchHavePending;
+	bool		batchDone;
+} SeqScanState;
 
 /*
  * SampleScan
@@ -1411,6 +1518,7 @@ typedef struct BitmapIndexScanState
  *	 BitmapHeapScanState information
  *
  *		bitmapqualorig	   execution state for bitmapqualorig expressions
+ *		initialized		   have we built the bitmap and begun iterating?
  *		tbm				   bitmap obtained from child index scan(s)
  *		tbmiterator		   iterator for scanning current pages
  *		tbmres			   current-page data
@@ -1419,12 +1527,17 @@ typedef struct BitmapIndexScanState
  *		prefetch_iterator  iterator for prefetching ahead of current page
  *		prefetch_pages	   # pages prefetch iterator is ahead of current
  *		prefetch_target    target prefetch distance
+ *		pstate			   shared state in DSM, if running in parallel
+ *		shared_iterator    iterator over the shared bitmap, if any
  * ----------------
  */
+typedef struct ParallelBitmapHeapStateData *ParallelBitmapHeapState;
+
 typedef struct BitmapHeapScanState
 {
 	ScanState	ss;				/* its first field is NodeTag */
 	List	   *bitmapqualorig;
+	bool		initialized;
 	TIDBitmap  *tbm;
 	TBMIterator *tbmiterator;
 	TBMIterateResult *tbmres;
@@ -1433,6 +1546,8 @@ typedef struct BitmapHeapScanState
 	TBMIterator *prefetch_iterator;
 	int			prefetch_pages;
 	int			prefetch_target;
+	ParallelBitmapHeapState pstate;
+	TBMSharedIterator *shared_iterator;
 } BitmapHeapScanState;
 
 /* ----------------
@@ -1571,6 +1686,7 @@ typedef struct WorkTableScanState
 typedef struct ForeignScanState
 {
 	ScanState	ss;				/* its first field is NodeTag */
+	Size		pscan_len;		/* size of parallel coordination information */
 	/* use struct pointer to avoid including fdwapi.h here */
 	struct FdwRoutine *fdwroutine;
 	void	   *fdw_state;		/* foreign-data wrapper can keep state here */
@@ -1643,6 +1759,13 @@ typedef struct JoinState
  *		NeedNewOuter	   true if need new outer tuple on next call
  *		MatchedOuter	   true if found a join match for current outer tuple
  *		NullInnerTupleSlot prepared null tuple for left outer joins
+ *		HashClauses		   hashable join clauses (plan exprs), or NIL if
+ *						   we can't switch to a hash join
+ *		OtherJoinQual	   the rest of the join clauses (plan exprs)
+ *		OuterRows		   number of outer tuples read in this scan
+ *		SwitchRows		   outer tuples read before switching to a hash join
+ *		SwitchedAfter	   OuterRows when we first switched, for EXPLAIN
+ *		HashJoin		   hash join doing our work since the switch, if any
  * ----------------
  */
 typedef struct NestLoopState
@@ -1651,6 +1774,12 @@ typedef struct NestLoopState
 	bool		nl_NeedNewOuter;
 	bool		nl_MatchedOuter;
 	TupleTableSlot *nl_NullInnerTupleSlot;
+	List	   *nl_HashClauses;
+	List	   *nl_OtherJoinQual;
+	double		nl_OuterRows;
+	double		nl_SwitchRows;
+	double		nl_SwitchedAfter;
+	struct HashJoinState *nl_HashJoin;
 } NestLoopState;
 
 /* ----------------
@@ -1672,6 +1801,12 @@ typedef struct NestLoopState
  *		NullInnerTupleSlot prepared null tuple for left outer joins
  *		OuterEContext	   workspace for computing outer tuple's join values
  *		InnerEContext	   workspace for computing inner tuple's join values
+ *		InnerGroup		   buffered inner tuples following the mark, if we
+ *						   do mark/restore ourselves rather than the inner
+ *						   plan; NULL otherwise
+ *		InnerGroupSlot	   slot for tuples read back from InnerGroup
+ *		BufferingGroup	   true if inner tuples must be added to InnerGroup
+ *		InnerEOF		   true if inner plan has returned end of data
  * ----------------
  */
 /* private in nodeMergejoin.c: */
@@ -1696,6 +1831,10 @@ typedef struct MergeJoinState
 	TupleTableSlot *mj_NullInnerTupleSlot;
 	ExprContext *mj_OuterEContext;
 	ExprContext *mj_InnerEContext;
+	Tuplestorestate *mj_InnerGroup;
+	TupleTableSlot *mj_InnerGroupSlot;
+	bool		mj_BufferingGroup;
+	bool		mj_InnerEOF;
 } MergeJoinState;
 
 /* ----------------
@@ -1714,6 +1853,7 @@ typedef struct MergeJoinState
  *								tuple, or NULL if starting search
  *								(hj_CurXXX variables are undefined if
  *								OuterTupleSlot is empty!)
+ *		hj_CurSharedTuple		same as hj_CurTuple, for a shared hash table
  *		hj_OuterTupleSlot		tuple slot for outer tuples
  *		hj_HashTupleSlot		tuple slot for inner (hashed) tuples
  *		hj_NullOuterTupleSlot	prepared null tuple for right/full outer joins
@@ -1722,12 +1862,15 @@ typedef struct MergeJoinState
  *		hj_JoinState			current state of ExecHashJoin state machine
  *		hj_MatchedOuter			true if found a join match for current outer
  *		hj_OuterNotEmpty		true if outer relation known not empty
+ *		hj_JoinFilter			Bloom filter pushed down to the outer scan
  * ----------------
  */
 
 /* these structs are defined in executor/hashjoin.h: */
 typedef struct HashJoinTupleData *HashJoinTuple;
 typedef struct HashJoinTableData *HashJoinTable;
+typedef struct SharedHashJoinTupleData *SharedHashJoinTuple;
+typedef struct SharedHashJoinTableData *SharedHashJoinTable;
 
 typedef struct HashJoinState
 {
@@ -1741,6 +1884,7 @@ typedef struct HashJoinState
 	int			hj_CurBucketNo;
 	int			hj_CurSkewBucketNo;
 	HashJoinTuple hj_CurTuple;
+	SharedHashJoinTuple hj_CurSharedTuple;
 	TupleTableSlot *hj_OuterTupleSlot;
 	TupleTableSlot *hj_HashTupleSlot;
 	TupleTableSlot *hj_NullOuterTupleSlot;
@@ -1749,8 +1893,37 @@ typedef struct HashJoinState
 	int			hj_JoinState;
 	bool		hj_MatchedOuter;
 	bool		hj_OuterNotEmpty;
+	struct JoinFilterState *hj_JoinFilter;
 } HashJoinState;
 
+/* ----------------
+ *	 JoinFilterState information
+ *
+ *		A hash join whose outer side is a plain scan, and which can discard
+ *		outer tuples without a match, builds a Bloom filter of the hash
+ *		values of its inner tuples while building its hash table.  The scan
+ *		then tests the filter before its qual, so that tuples certain not to
+ *		find a match are discarded without being projected or passed up.
+ *
+ *		hashtable		hash table holding the filter, or NULL when there is
+ *						none to test
+ *		hashkeys		outer hash keys, as ExprStates over the scan tuple
+ *		econtext		expression context for evaluating them
+ *		ntested			tuples tested against the filter
+ *		nremoved		tuples removed by the filter
+ *		nremoved_total	tuples removed, across rescans (for EXPLAIN)
+ * ----------------
+ */
+typedef struct JoinFilterState
+{
+	HashJoinTable hashtable;
+	List	   *hashkeys;
+	ExprContext *econtext;
+	double		ntested;
+	double		nremoved;
+	double		nremoved_total;
+} JoinFilterState;
+
 
 /* ----------------------------------------------------------------
  *				 Materialization State Information
@@ -1774,6 +1947,43 @@ typedef struct MaterialState
 	Tuplestorestate *tuplestorestate;
 } MaterialState;
 
+/* ----------------
+ *	 MemoizeState information
+ *
+ *		memoize nodes keep the results of their subplan for each distinct
+ *		set of parameter values in a hash table, evicting the least
+ *		recently used ones when the table outgrows work_mem.
+ *
+ *		keyparamids are the PARAM_EXEC params the cache key depends on; a
+ *		rescan due to a change in any other param empties the cache.
+ * ----------------
+ */
+typedef struct MemoizeState
+{
+	ScanState	ss;				/* its first field is NodeTag */
+	int			mstatus;		/* state of ExecMemoize state machine */
+	List	   *param_exprs;	/* cache key expressions (ExprStates) */
+	Bitmapset  *keyparamids;	/* PARAM_EXEC params used by param_exprs */
+	FmgrInfo   *eqfunctions;	/* per-key equality functions */
+	FmgrInfo   *hashfunctions;	/* per-key hash functions */
+	AttrNumber *keyColIdx;		/* 1..numKeys, for the hash table */
+	TupleHashTable hashtable;	/* the cache */
+	MemoryContext tableContext; /* memory context holding the cache */
+	TupleTableSlot *probeslot;	/* current key values */
+	TupleTableSlot *removeslot; /* key of an entry being evicted */
+	dlist_head	lru_list;		/* entries, most recently used first */
+	struct MemoizeEntry *entry; /* entry being read or filled */
+	struct MemoizeTuple *last_tuple;	/* last tuple returned from entry */
+	Size		mem_used;		/* memory used by the cache */
+	Size		mem_limit;		/* memory the cache may use */
+	/* statistics for EXPLAIN ANALYZE */
+	long		cache_hits;		/* lookups answered from the cache */
+	long		cache_misses;	/* lookups that had to run the subplan */
+	long		cache_evictions;	/* entries evicted to make room */
+	long		cache_overflows;	/* results too big to cache at all */
+	Size		mem_peak;		/* peak memory used by the cache */
+} MemoizeState;
+
 /* ----------------
  *	 SortState information
  * ----------------
@@ -1790,6 +2000,34 @@ typedef struct SortState
 	void	   *tuplesortstate; /* private state of tuplesort.c */
 } SortState;
 
+/* ----------------
+ *	 IncrementalSortState information
+ *
+ *		The input is read in batches of tuples that agree on the presorted
+ *		columns, and each batch is sorted and returned before the next is
+ *		read.  pivotSlot holds the tuple whose presorted columns the rest of
+ *		the current batch must match, and transferSlot the first tuple of the
+ *		next batch, if it has been read already.
+ * ----------------
+ */
+typedef struct IncrementalSortState
+{
+	ScanState	ss;				/* its first field is NodeTag */
+	bool		bounded;		/* is the result set bounded? */
+	int64		bound;			/* if bounded, how many tuples are needed */
+	FmgrInfo   *eqfunctions;	/* equality fns for the presorted columns */
+	TupleTableSlot *pivotSlot;	/* tuple the current batch must match */
+	TupleTableSlot *transferSlot;	/* first tuple of the next batch */
+	bool		outerDone;		/* has the outer plan been exhausted? */
+	int64		tuplesReturned; /* tuples returned since (re)start */
+	void	   *tuplesortstate; /* tuplesort.c state for current batch */
+	/* statistics for EXPLAIN ANALYZE */
+	long		batchesSorted;	/* number of batches sorted */
+	const char *maxSortMethod;	/* sort method of the largest batch */
+	const char *maxSpaceType;	/* space type of the largest batch */
+	long		maxSpaceUsed;	/* space used by the largest batch */
+} IncrementalSortState;
+
 /* ---------------------
  *	GroupState information
  * -------------------------
@@ -1817,6 +2055,7 @@ typedef struct GroupState
 typedef struct AggStatePerAggData *AggStatePerAgg;
 typedef struct AggStatePerGroupData *AggStatePerGroup;
 typedef struct AggStatePerPhaseData *AggStatePerPhase;
+typedef struct AggStatePerHashData *AggStatePerHash;
 
 typedef struct AggState
 {
@@ -1826,7 +2065,6 @@ typedef struct AggState
 	AggStatePerPhase phase;		/* pointer to current phase data */
 	int			numphases;		/* number of phases */
 	int			current_phase;	/* current phase number */
-	FmgrInfo   *hashfunctions;	/* per-grouping-field hash fns */
 	AggStatePerAgg peragg;		/* per-Aggref information */
 	ExprContext **aggcontexts;	/* econtexts for long-lived data (per GS) */
 	ExprContext *tmpcontext;	/* econtext for input expressions */
@@ -1848,11 +2086,21 @@ typedef struct AggState
 	AggStatePerGroup pergroup;	/* per-Aggref-per-group working state */
 	HeapTuple	grp_firstTuple; /* copy of first tuple of current group */
 	/* these fields are used in AGG_HASHED mode: */
-	TupleHashTable hashtable;	/* hash table with one entry per group */
-	TupleTableSlot *hashslot;	/* slot for loading hash table */
-	List	   *hash_needed;	/* list of columns needed in hash table */
-	bool		table_filled;	/* hash table filled yet? */
-	TupleHashIterator hashiter; /* for iterating through hash table */
+	AggStatePerHash perhash;	/* array of per-hashtable data */
+	int			numhashes;		/* number of hash tables (grouping sets) */
+	AggStatePerGroup *hash_pergroups;	/* working state for each set */
+	bool		table_filled;	/* hash tables filled yet? */
+	int			hash_iter_set;	/* set whose hash table is being returned */
+	Size		hash_mem_limit; /* stop adding groups beyond this much memory */
+	bool		hash_spill_mode;	/* spilling tuples of new groups? */
+	int			hash_pass_set;	/* set being re-read from disk, or -1 */
+	int			hash_spill_level;	/* # of times current input was spilled */
+	List	   *hash_pending;	/* spilled partitions not yet processed */
+	struct BufFile *hash_input_file;	/* partition being read, or NULL */
+	TupleTableSlot *hash_spill_slot;	/* slot for reading spilled tuples */
+	bool		hash_spilled;	/* did this scan spill anything? */
+	int			hash_batches_used;	/* # of batches processed, for EXPLAIN */
+	Size		hash_mem_peak;	/* peak memory of hash table, for EXPLAIN */
 } AggState;
 
 /* ----------------
@@ -1938,6 +2186,25 @@ typedef struct UniqueState
 	MemoryContext tempContext;	/* short-term context for comparisons */
 } UniqueState;
 
+/* ----------------
+ * GatherState information
+ *
+ *		Gather nodes launch 1 or more parallel workers, run a subplan
+ *		in those workers, and collect the results.
+ * ----------------
+ */
+typedef struct GatherState
+{
+	PlanState	ps;				/* its first field is NodeTag */
+	bool		initialized;	/* workers launched (or decided not to)? */
+	struct ParallelExecutorInfo *pei;	/* parallel state, if launched */
+	int			nreaders;		/* number of still-active workers */
+	int			nextreader;		/* next one to try to read from */
+	struct TupleQueueReader **reader;	/* array with nreaders active entries */
+	TupleTableSlot *funnel_slot;	/* slot for tuples read from workers */
+	bool		need_to_scan_locally;	/* need to read from local plan? */
+} GatherState;
+
 /* ----------------
  *	 HashState information
  * ----------------
@@ -1948,6 +2215,7 @@ typedef struct HashState
 	HashJoinTable hashtable;	/* hash table for the hashjoin */
 	List	   *hashkeys;		/* list of ExprState nodes */
 	/* hashkeys is same as parent's hj_InnerHashKeys */
+	SharedHashJoinTable shared_table;	/* table in DSM, if parallel-aware */
 } HashState;
 
 /* ----------------
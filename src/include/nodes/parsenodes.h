@@ -1171,13 +1171,22 @@ typedef struct OnConflictClause
  *
  * We don't currently support the SEARCH or CYCLE clause.
  */
+typedef enum CTEMaterialize
+{
+	CTEMaterializeDefault,		/* no option specified */
+	CTEMaterializeAlways,		/* MATERIALIZED */
+	CTEMaterializeNever			/* NOT MATERIALIZED */
+} CTEMaterialize;
+
 typedef struct CommonTableExpr
 {
 	NodeTag		type;
 	char	   *ctename;		/* query name (never qualified) */
 	List	   *aliascolnames;	/* optional list of column names */
+	CTEMaterialize ctematerialized;		/* is this an optimization fence? */
 	/* SelectStmt/InsertStmt/etc before parse analysis, Query afterwards: */
 	Node	   *ctequery;		/* the CTE's subquery */
+	List	   *ctecyclecols;	/* optional CYCLE column names */
 	int			location;		/* token location, or -1 if unknown */
 	/* These fields are set during parse analysis: */
 	bool		cterecursive;	/* is this CTE actually recursive? */
@@ -1352,6 +1361,9 @@ typedef struct SetOperationStmt
 	List	   *colCollations;	/* OID list of output column collation OIDs */
 	List	   *groupClauses;	/* a list of SortGroupClause's */
 	/* groupClauses is NIL if UNION ALL, but must be set otherwise */
+	List	   *cycleColIdx;	/* integer list of CYCLE column numbers */
+	List	   *cycleClauses;	/* SortGroupClause's for the CYCLE columns */
+	/* these two are NIL unless this is a recursive CTE with CYCLE */
 } SetOperationStmt;
 
 
@@ -2065,6 +2077,21 @@ typedef struct AlterPolicyStmt
  *		Create TRIGGER Statement
  * ----------------------
  */
+/*
+ * TriggerTransition -
+ *	   an item of the REFERENCING clause of CREATE TRIGGER
+ *
+ * Only transition tables are supported, but transition row names are
+ * accepted by the grammar so that we can give a meaningful message.
+ */
+typedef struct TriggerTransition
+{
+	NodeTag		type;
+	char	   *name;			/* name given to the transition relation */
+	bool		isNew;			/* NEW, else OLD */
+	bool		isTable;		/* TABLE, else ROW */
+} TriggerTransition;
+
 typedef struct CreateTrigStmt
 {
 	NodeTag		type;
@@ -2078,6 +2105,7 @@ typedef struct CreateTrigStmt
 	/* events uses the TRIGGER_TYPE bits defined in catalog/pg_trigger.h */
 	int16		events;			/* "OR" of INSERT/UPDATE/DELETE/TRUNCATE */
 	List	   *columns;		/* column names, or NIL for all columns */
+	List	   *transitionRels; /* TriggerTransition nodes, or NIL if none */
 	Node	   *whenClause;		/* qual expression, or NULL if none */
 	bool		isconstraint;	/* This is a constraint trigger */
 	/* The remaining fields are only used for constraint triggers */
@@ -2352,6 +2380,7 @@ typedef struct SecLabelStmt
 #define CURSOR_OPT_FAST_PLAN	0x0020	/* prefer fast-start plan */
 #define CURSOR_OPT_GENERIC_PLAN 0x0040	/* force use of generic plan */
 #define CURSOR_OPT_CUSTOM_PLAN	0x0080	/* force use of custom plan */
+#define CURSOR_OPT_PARALLEL_OK	0x0100	/* parallel mode OK */
 
 typedef struct DeclareCursorStmt
 {
@@ -2416,6 +2445,8 @@ typedef struct IndexStmt
 	char	   *accessMethod;	/* name of access method (eg. btree) */
 	char	   *tableSpace;		/* tablespace, or NULL for default */
 	List	   *indexParams;	/* columns to index: a list of IndexElem */
+	List	   *indexIncludingParams;	/* non-key INCLUDE columns: a list of
+										 * IndexElem */
 	List	   *options;		/* WITH clause options: a list of DefElem */
 	Node	   *whereClause;	/* qualification (partial-index predicate) */
 	List	   *excludeOpNames; /* exclusion operator names, or NIL if none */
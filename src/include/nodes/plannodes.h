@@ -71,6 +71,8 @@ typedef struct PlannedStmt
 	int			nParamExec;		/* number of PARAM_EXEC Params used */
 
 	bool		hasRowSecurity; /* row security applied? */
+
+	bool		parallelModeNeeded;		/* parallel mode required to execute? */
 } PlannedStmt;
 
 /* macro for fetching the Plan associated with a SubPlan node */
@@ -106,9 +108,15 @@ typedef struct Plan
 	double		plan_rows;		/* number of rows plan is expected to emit */
 	int			plan_width;		/* average row width in bytes */
 
+	/*
+	 * information needed for parallel query
+	 */
+	bool		parallel_aware; /* engage parallel-aware logic? */
+
 	/*
 	 * Common structural data for all Plan types.
 	 */
+	int			plan_node_id;	/* unique across entire final plan tree */
 	List	   *targetlist;		/* target list to be computed at this node */
 	List	   *qual;			/* implicitly-ANDed qual conditions */
 	struct Plan *lefttree;		/* input plan tree(s) */
@@ -180,6 +188,7 @@ typedef struct ModifyTable
 	List	   *withCheckOptionLists;	/* per-target-table WCO lists */
 	List	   *returningLists; /* per-target-table RETURNING tlists */
 	List	   *fdwPrivLists;	/* per-target-table FDW private data lists */
+	Bitmapset  *fdwDirectModifyPlans;	/* indexes of plans done by FDW */
 	List	   *rowMarks;		/* PlanRowMarks (non-locking only) */
 	int			epqParam;		/* ID of Param for EvalPlanQual re-eval */
 	OnConflictAction onConflictAction;	/* ON CONFLICT action */
@@ -193,12 +202,21 @@ typedef struct ModifyTable
 /* ----------------
  *	 Append node -
  *		Generate the concatenation of the results of sub-plans.
+ *
+ * If some sub-plans scan inheritance children whose restriction clauses use
+ * external Params, the executor can repeat constraint exclusion once their
+ * values are known, and skip the sub-plans that can't return any rows.
+ * prunequals and pruneconstrs then have one item per sub-plan: the implicit-
+ * AND lists of its relation's restriction clauses and constraints, or NIL
+ * if it can't be pruned.  Both are NIL if no sub-plan can be pruned.
  * ----------------
  */
 typedef struct Append
 {
 	Plan		plan;
 	List	   *appendplans;
+	List	   *prunequals;		/* per-subplan restriction clauses */
+	List	   *pruneconstrs;	/* per-subplan constraints */
 } Append;
 
 /* ----------------
@@ -210,6 +228,8 @@ typedef struct MergeAppend
 {
 	Plan		plan;
 	List	   *mergeplans;
+	List	   *prunequals;		/* as in Append */
+	List	   *pruneconstrs;	/* as in Append */
 	/* remaining fields are just like the sort-key info in struct Sort */
 	int			numCols;		/* number of sort-key columns */
 	AttrNumber *sortColIdx;		/* their indexes in the target list */
@@ -230,7 +250,7 @@ typedef struct RecursiveUnion
 {
 	Plan		plan;
 	int			wtParam;		/* ID of Param representing work table */
-	/* Remaining fields are zero/null in UNION ALL case */
+	/* Remaining fields are zero/null in UNION ALL case, unless CYCLE */
 	int			numCols;		/* number of columns to check for
 								 * duplicate-ness */
 	AttrNumber *dupColIdx;		/* their indexes in the target list */
@@ -512,6 +532,7 @@ typedef struct WorkTableScan
 typedef struct ForeignScan
 {
 	Scan		scan;
+	CmdType		operation;		/* SELECT, or UPDATE/DELETE done directly */
 	Oid			fs_server;		/* OID of foreign server */
 	List	   *fdw_exprs;		/* expressions that FDW may evaluate */
 	List	   *fdw_private;	/* private data for FDW */
@@ -652,6 +673,25 @@ typedef struct Material
 	Plan		plan;
 } Material;
 
+/* ----------------
+ *		memoize node
+ *
+ * Caches the output of a parameterized inner side of a nestloop, keyed by
+ * the values of param_exprs, so that rescans with parameter values seen
+ * before don't have to run the subplan again.  param_exprs may only refer
+ * to PARAM_EXEC Params.
+ * ----------------
+ */
+typedef struct Memoize
+{
+	Plan		plan;
+	int			numKeys;		/* number of cache key expressions */
+	Oid		   *hashOperators;	/* hash equality operators, one per key */
+	List	   *param_exprs;	/* cache key expressions */
+	bool		singlerow;		/* caller reads at most one row per scan */
+	long		est_entries;	/* estimated number of cache entries */
+} Memoize;
+
 /* ----------------
  *		sort node
  * ----------------
@@ -666,6 +706,19 @@ typedef struct Sort
 	bool	   *nullsFirst;		/* NULLS FIRST/LAST directions */
 } Sort;
 
+/* ----------------
+ *		incremental sort node
+ *
+ * Like Sort, except that the input is known to be sorted already on the
+ * first presortedCols sort columns, so it can be sorted a group at a time.
+ * ----------------
+ */
+typedef struct IncrementalSort
+{
+	Sort		sort;
+	int			presortedCols;	/* number of presorted leading sort columns */
+} IncrementalSort;
+
 /* ---------------
  *	 group node -
  *		Used for queries with GROUP BY (but no aggregates) specified.
@@ -705,6 +758,8 @@ typedef struct Agg
 {
 	Plan		plan;
 	AggStrategy aggstrategy;
+	bool		combineStates;	/* input tuples contain transition states */
+	bool		finalizeAggs;	/* should we call the finalfn on agg states? */
 	int			numCols;		/* number of grouping columns */
 	AttrNumber *grpColIdx;		/* their indexes in the target list */
 	Oid		   *grpOperators;	/* equality operators to compare with */
@@ -744,6 +799,20 @@ typedef struct Unique
 	Oid		   *uniqOperators;	/* equality operators to compare with */
 } Unique;
 
+/* ------------
+ *		gather node
+ *
+ * A Gather node launches num_workers background workers, each of which
+ * executes a copy of the plan below it, and returns the union of the
+ * tuples they (and, usually, the leader process itself) produce.
+ * ------------
+ */
+typedef struct Gather
+{
+	Plan		plan;
+	int			num_workers;	/* number of workers to request */
+} Gather;
+
 /* ----------------
  *		hash build node
  *
@@ -761,6 +830,7 @@ typedef struct Hash
 	bool		skewInherit;	/* is outer join rel an inheritance tree? */
 	Oid			skewColType;	/* datatype of the outer key column */
 	int32		skewColTypmod;	/* typmod of the outer key column */
+	double		rows_total;		/* estimated total rows if parallel_aware */
 	/* all other info is in the parent HashJoin node */
 } Hash;
 
@@ -98,6 +98,8 @@ typedef struct IntoClause
 	char	   *tableSpaceName; /* table space to use, or NULL */
 	Node	   *viewQuery;		/* materialized view's SELECT query */
 	bool		skipData;		/* true for WITH NO DATA */
+	bool		incremental;	/* true for CREATE INCREMENTAL MATERIALIZED
+								 * VIEW */
 } IntoClause;
 
 
@@ -102,6 +102,12 @@ typedef struct PlannerGlobal
 	bool		transientPlan;	/* redo plan when TransactionXmin changes? */
 
 	bool		hasRowSecurity; /* row security applied? */
+
+	int			lastPlanNodeId; /* highest plan node ID assigned */
+
+	bool		parallelModeOK; /* parallel mode potentially OK? */
+
+	bool		parallelModeNeeded;		/* parallel mode actually required? */
 } PlannerGlobal;
 
 /* macro for fetching the Plan associated with a SubPlan node */
@@ -324,6 +330,8 @@ typedef struct PlannerInfo
  *		consider_startup - true if there is any value in keeping plain paths for
  *						   this rel on the basis of having cheap startup cost
  *		consider_param_startup - the same for parameterized paths
+ *		consider_parallel - true if it's safe to scan this rel in a
+ *							parallel worker (see set_rel_consider_parallel)
  *		reltargetlist - List of Var and PlaceHolderVar nodes for the values
  *						we need to output from this relation.
  *						List is in no particular order, but all rels of an
@@ -333,6 +341,10 @@ typedef struct PlannerInfo
  *		pathlist - List of Path nodes, one for each potentially useful
  *				   method of generating the relation
  *		ppilist - ParamPathInfo nodes for parameterized Paths, if any
+ *		partial_pathlist - parallel-aware Paths that each produce only part
+ *				   of the relation, to be run in workers under a Gather;
+ *				   kept separately since add_path can't compare them
+ *				   against complete paths
  *		cheapest_startup_path - the pathlist member with lowest startup cost
  *			(regardless of ordering) among the unparameterized paths;
  *			or NULL if there is no unparameterized path
@@ -397,6 +409,10 @@ typedef struct PlannerInfo
  *					note this excludes clauses that might be derivable from
  *					EquivalenceClasses)
  *		has_eclass_joins - flag that EquivalenceClass joins are possible
+ *		join_partner_relids - relids of the other rels mentioned by a join
+ *					clause or an EquivalenceClass together with this
+ *					relation; used to answer have_relevant_joinclause()
+ *					quickly during join search
  *
  * Note: Keeping a restrictinfo list in the RelOptInfo is useful only for
  * base rels, because for a join rel the set of clauses that are treated as
@@ -439,11 +455,13 @@ typedef struct RelOptInfo
 	/* per-relation planner control flags */
 	bool		consider_startup;		/* keep cheap-startup-cost paths? */
 	bool		consider_param_startup; /* ditto, for parameterized paths? */
+	bool		consider_parallel;		/* consider parallel paths? */
 
 	/* materialization information */
 	List	   *reltargetlist;	/* Vars to be output by scan of relation */
 	List	   *pathlist;		/* Path structures */
 	List	   *ppilist;		/* ParamPathInfos used in pathlist */
+	List	   *partial_pathlist;		/* partial Paths */
 	struct Path *cheapest_startup_path;
 	struct Path *cheapest_total_path;
 	struct Path *cheapest_unique_path;
@@ -482,6 +500,7 @@ typedef struct RelOptInfo
 	List	   *joininfo;		/* RestrictInfo structures for join clauses
 								 * involving this rel */
 	bool		has_eclass_joins;		/* T means joininfo is incomplete */
+	Relids		join_partner_relids;	/* rels we have joinclauses with */
 } RelOptInfo;
 
 /*
@@ -489,7 +508,10 @@ typedef struct RelOptInfo
  *		Per-index information for planning/optimization
  *
  *		indexkeys[], indexcollations[], opfamily[], and opcintype[]
- *		each have ncolumns entries.
+ *		each have ncolumns entries.  Only the first nkeycolumns of those are
+ *		key columns; any others are non-key INCLUDE columns, which can be
+ *		returned by index-only scans but have zero opfamily[] and opcintype[]
+ *		and can't be used to match quals or orderings.
  *
  *		sortopfamily[], reverse_sort[], and nulls_first[] likewise have
  *		ncolumns entries, if the index is ordered; but if it is unordered,
@@ -525,6 +547,7 @@ typedef struct IndexOptInfo
 
 	/* index descriptor information */
 	int			ncolumns;		/* number of columns in index */
+	int			nkeycolumns;	/* number of key columns in index */
 	int		   *indexkeys;		/* column numbers of index's keys, or 0 */
 	Oid		   *indexcollations;	/* OIDs of collations of index columns */
 	Oid		   *opfamily;		/* OIDs of operator families for columns */
@@ -553,6 +576,7 @@ typedef struct IndexOptInfo
 	bool		amsearchnulls;	/* can AM search for NULL/NOT NULL entries? */
 	bool		amhasgettuple;	/* does AM have amgettuple interface? */
 	bool		amhasgetbitmap; /* does AM have amgetbitmap interface? */
+	bool		amcanparallel;	/* does AM support parallel scans? */
 } IndexOptInfo;
 
 
@@ -731,6 +755,12 @@ typedef struct ParamPathInfo
  *
  * "pathkeys" is a List of PathKey nodes (see above), describing the sort
  * ordering of the path's output rows.
+ *
+ * "parallel_aware" is true if the plan built from this path must coordinate
+ * with other copies of itself running in parallel workers, and
+ * "parallel_degree" is the number of workers it was costed for.  Such a
+ * "partial" path produces only a subset of the relation's rows in each
+ * process, so it is only useful underneath a GatherPath.
  */
 typedef struct Path
 {
@@ -741,6 +771,10 @@ typedef struct Path
 	RelOptInfo *parent;			/* the relation this path can build */
 	ParamPathInfo *param_info;	/* parameterization info, or NULL if none */
 
+	bool		parallel_aware; /* engage parallel-aware logic? */
+	int			parallel_degree;	/* desired parallel degree; 0 = not
+									 * parallel */
+
 	/* estimated size/costs for path (see costsize.c for more info) */
 	double		rows;			/* estimated number of result tuples */
 	Cost		startup_cost;	/* cost expended before fetching any tuples */
@@ -1002,6 +1036,24 @@ typedef struct MaterialPath
 	Path	   *subpath;
 } MaterialPath;
 
+/*
+ * MemoizePath represents use of a Memoize plan node, i.e., caching the
+ * output of a parameterized subpath for each distinct set of values of
+ * param_exprs, the outer-relation expressions the parameters come from.
+ * calls is the expected number of rescans, and est_entries the number of
+ * entries we expect to fit in the cache.
+ */
+typedef struct MemoizePath
+{
+	Path		path;
+	Path	   *subpath;
+	List	   *param_exprs;	/* cache key expressions */
+	List	   *hash_operators; /* hash equality operator OIDs, per key */
+	bool		singlerow;		/* caller reads at most one row per scan */
+	double		calls;			/* expected number of rescans */
+	double		est_entries;	/* expected number of cache entries */
+} MemoizePath;
+
 /*
  * UniquePath represents elimination of distinct rows from the output of
  * its subpath.
@@ -1031,6 +1083,18 @@ typedef struct UniquePath
 	List	   *uniq_exprs;		/* expressions to be made unique */
 } UniquePath;
 
+/*
+ * GatherPath runs several copies of a plan in parallel and collects the
+ * results.  The parallel leader may also execute the plan, unless it's
+ * busy collecting tuples from the workers.
+ */
+typedef struct GatherPath
+{
+	Path		path;
+	Path	   *subpath;		/* path for each worker */
+	int			num_workers;	/* number of workers sought to help */
+} GatherPath;
+
 /*
  * All join-type paths share these fields.
  */
@@ -1103,6 +1167,11 @@ typedef struct MergePath
  *
  * Hashjoin does not care what order its inputs appear in, so we have
  * no need for sortkeys.
+ *
+ * If parallel_hash is true, the inner path is a partial path, and all the
+ * participants of a parallel plan build a single hash table in shared memory
+ * from its output; inner_rows_total is then the estimated size of that
+ * table, which is larger than the inner path's per-participant row count.
  */
 
 typedef struct HashPath
@@ -1110,6 +1179,8 @@ typedef struct HashPath
 	JoinPath	jpath;
 	List	   *path_hashclauses;		/* join clauses used for hashing */
 	int			num_batches;	/* number of batches expected */
+	bool		parallel_hash;	/* build a shared hash table? */
+	double		inner_rows_total;		/* total inner rows expected */
 } HashPath;
 
 /*
@@ -1733,6 +1804,7 @@ typedef struct JoinCostWorkspace
 	/* private for cost_hashjoin code */
 	int			numbuckets;
 	int			numbatches;
+	double		inner_rows_total;
 } JoinCostWorkspace;
 
 #endif   /* RELATION_H */
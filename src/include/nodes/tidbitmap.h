@@ -34,6 +34,13 @@ typedef struct TIDBitmap TIDBitmap;
 /* Likewise, TBMIterator is private */
 typedef struct TBMIterator TBMIterator;
 
+/*
+ * State of an iteration shared between processes, in memory supplied by the
+ * caller (see tbm_shared_estimate), and a process's handle on it.
+ */
+typedef struct TBMSharedIteratorState TBMSharedIteratorState;
+typedef struct TBMSharedIterator TBMSharedIterator;
+
 /* Result structure for tbm_iterate */
 typedef struct
 {
@@ -63,4 +70,11 @@ extern TBMIterator *tbm_begin_iterate(TIDBitmap *tbm);
 extern TBMIterateResult *tbm_iterate(TBMIterator *iterator);
 extern void tbm_end_iterate(TBMIterator *iterator);
 
+extern Size tbm_shared_estimate(double ntuples, long maxbytes);
+extern void tbm_shared_init(TBMSharedIteratorState *state, Size size);
+extern bool tbm_shared_fill(TIDBitmap *tbm, TBMSharedIteratorState *state);
+extern TBMSharedIterator *tbm_attach_shared_iterate(TBMSharedIteratorState *state);
+extern TBMIterateResult *tbm_shared_iterate(TBMSharedIterator *iterator);
+extern void tbm_end_shared_iterate(TBMSharedIterator *iterator);
+
 #endif   /* TIDBITMAP_H */
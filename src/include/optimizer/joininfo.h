@@ -19,6 +19,7 @@
 
 extern bool have_relevant_joinclause(PlannerInfo *root,
 						 RelOptInfo *rel1, RelOptInfo *rel2);
+extern void set_base_rel_join_partners(PlannerInfo *root, RelOptInfo *rel);
 
 extern void add_join_clause_to_rels(PlannerInfo *root,
 						RestrictInfo *restrictinfo,
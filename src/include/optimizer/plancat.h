@@ -38,6 +38,12 @@ extern int32 get_relation_data_width(Oid relid, int32 *attr_widths);
 extern bool relation_excluded_by_constraints(PlannerInfo *root,
 								 RelOptInfo *rel, RangeTblEntry *rte);
 
+extern bool get_relation_prune_info(PlannerInfo *root, RelOptInfo *rel,
+						List **quals, List **constraints);
+
+extern bool appendrel_members_disjoint(PlannerInfo *root, Index parent_relid,
+						   AttrNumber attno, List *member_rels);
+
 extern List *build_physical_tlist(PlannerInfo *root, RelOptInfo *rel);
 
 extern bool has_unique_index(RelOptInfo *rel, AttrNumber attno);
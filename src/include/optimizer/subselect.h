@@ -19,6 +19,10 @@ extern void SS_process_ctes(PlannerInfo *root);
 extern JoinExpr *convert_ANY_sublink_to_join(PlannerInfo *root,
 							SubLink *sublink,
 							Relids available_rels);
+extern JoinExpr *convert_NOT_IN_sublink_to_join(PlannerInfo *root,
+							   SubLink *sublink,
+							   Relids available_rels,
+							   Node *jtnode);
 extern JoinExpr *convert_EXISTS_sublink_to_join(PlannerInfo *root,
 							   SubLink *sublink,
 							   bool under_not,
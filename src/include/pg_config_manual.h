@@ -224,6 +224,13 @@
  */
 #define PG_CACHE_LINE_SIZE		128
 
+/*
+ * Alignment of the memory used for data file I/O, which must be at least the
+ * sector size of the underlying storage if data_direct_io is to work.  Shared
+ * and local buffers are aligned to this.
+ */
+#define PG_IO_ALIGN_SIZE		4096
+
 /*
  *------------------------------------------------------------------------
  * The following symbols are for enabling debugging code, not for
@@ -0,0 +1,32 @@
+/*-------------------------------------------------------------------------
+ *
+ * pg_numa.h
+ *	  Platform-independent API for NUMA memory placement.
+ *
+ * Only Linux is supported at present.  On other platforms the functions
+ * report that no NUMA information is available, and callers are expected
+ * to fall back to treating the machine as a single node.
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * src/include/port/pg_numa.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef PG_NUMA_H
+#define PG_NUMA_H
+
+/* Upper limit on the number of nodes we keep track of */
+#define PG_NUMA_MAX_NODES	64
+
+/* Memory is placed in units of this size, the usual huge page size */
+#define PG_NUMA_PAGE_SIZE	(2 * 1024 * 1024)
+
+extern int	pg_numa_get_nodes(int *nodes, int maxnodes);
+extern int	pg_numa_current_node(void);
+extern bool pg_numa_bind_memory(void *start, Size len, int node);
+extern bool pg_numa_interleave_memory(void *start, Size len,
+						  const int *nodes, int nnodes);
+
+#endif   /* PG_NUMA_H */
@@ -0,0 +1,115 @@
+/*-------------------------------------------------------------------------
+ *
+ * simd.h
+ *	  Support for examining many bytes at a time with SIMD instructions.
+ *
+ * Only SSE2 is supported at present.  It's part of the x86-64 baseline, so
+ * it needs neither a configure test nor a runtime check.  Elsewhere,
+ * USE_SSE2 is not defined, and callers must use their plain byte-at-a-time
+ * code instead.
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * src/include/port/simd.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef SIMD_H
+#define SIMD_H
+
+#if defined(__x86_64__) || defined(_M_AMD64)
+#define USE_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/* A vector of bytes */
+typedef __m128i Vector8;
+
+/* Load a vector from memory, which needn't be aligned */
+static inline Vector8
+vector8_load(const char *s)
+{
+	return _mm_loadu_si128((const __m128i *) s);
+}
+
+/* A vector with every byte set to c */
+static inline Vector8
+vector8_broadcast(char c)
+{
+	return _mm_set1_epi8(c);
+}
+
+/* A vector with every byte set to zero */
+static inline Vector8
+vector8_zero(void)
+{
+	return _mm_setzero_si128();
+}
+
+/* Bytewise comparison: 0xFF where the bytes are equal, 0 elsewhere */
+static inline Vector8
+vector8_eq(Vector8 v1, Vector8 v2)
+{
+	return _mm_cmpeq_epi8(v1, v2);
+}
+
+static inline Vector8
+vector8_or(Vector8 v1, Vector8 v2)
+{
+	return _mm_or_si128(v1, v2);
+}
+
+static inline Vector8
+vector8_and(Vector8 v1, Vector8 v2)
+{
+	return _mm_and_si128(v1, v2);
+}
+
+/* Bytewise unsigned comparison: 0xFF where the byte of v1 is <= that of v2 */
+static inline Vector8
+vector8_le(Vector8 v1, Vector8 v2)
+{
+	return _mm_cmpeq_epi8(_mm_subs_epu8(v1, v2), _mm_setzero_si128());
+}
+
+/* A bitmask of the high bits of the bytes, bit 0 for the first byte */
+static inline uint32
+vector8_highbit_mask(Vector8 v)
+{
+	return (uint32) _mm_movemask_epi8(v);
+}
+
+/* Position of the lowest set bit of a nonzero mask */
+static inline int
+vector8_mask_first(uint32 mask)
+{
+	Assert(mask != 0);
+#if defined(__GNUC__)
+	return __builtin_ctz(mask);
+#elif defined(_MSC_VER)
+	{
+		unsigned long result;
+
+		_BitScanForward(&result, mask);
+		return (int) result;
+	}
+#else
+	{
+		int			result = 0;
+
+		while ((mask & 1) == 0)
+		{
+			mask >>= 1;
+			result++;
+		}
+		return result;
+	}
+#endif
+}
+
+#endif   /* __x86_64__ || _M_AMD64 */
+
+#endif   /* SIMD_H */
@@ -220,6 +220,13 @@ struct itimerval
 
 int			setitimer(int which, const struct itimerval * value, struct itimerval * ovalue);
 
+/* for FileReadV and FileWriteV in backend/storage/file/fd.c */
+struct iovec
+{
+	void	   *iov_base;
+	size_t		iov_len;
+};
+
 /*
  * WIN32 does not provide 64-bit off_t, but does provide the functions operating
  * with 64-bit offsets.
@@ -34,6 +34,9 @@ extern void CheckpointWriteDelay(int flags, double progress);
 extern bool ForwardFsyncRequest(RelFileNode rnode, ForkNumber forknum,
 					BlockNumber segno);
 extern void AbsorbFsyncRequests(void);
+extern uint32 GetFsyncRequestCycle(void);
+extern void CountSkippedFsyncRequest(void);
+extern void AdvanceFsyncRequestCycle(void);
 
 extern Size CheckpointerShmemSize(void);
 extern void CheckpointerShmemInit(void);
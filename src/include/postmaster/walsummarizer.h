@@ -0,0 +1,69 @@
+/*-------------------------------------------------------------------------
+ *
+ * walsummarizer.h
+ *	  Exports from postmaster/walsummarizer.c.
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ *
+ * src/include/postmaster/walsummarizer.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef _WALSUMMARIZER_H
+#define _WALSUMMARIZER_H
+
+#include "access/xlogdefs.h"
+#include "common/relpath.h"
+#include "postmaster/walsummary.h"
+#include "storage/block.h"
+#include "storage/relfilenode.h"
+#include "utils/hsearch.h"
+
+/*
+ * A set of modified blocks, per relation fork.
+ *
+ * Blocks at or past 'limit' are all to be considered modified, because the
+ * fork was created or truncated there.  An entry with relNode InvalidOid
+ * and limit 0 marks a whole database as created, by CREATE DATABASE or
+ * ALTER DATABASE SET TABLESPACE, which copy files without WAL-logging their
+ * blocks.
+ */
+typedef struct BlockRefKey
+{
+	RelFileNode rnode;
+	ForkNumber	forknum;
+} BlockRefKey;
+
+typedef struct BlockRefEntry
+{
+	BlockRefKey key;			/* hash key; must be first */
+	BlockNumber limit;			/* InvalidBlockNumber if none */
+	uint32		nblocks;		/* number of entries in blocks */
+	uint32		maxblocks;		/* allocated size of blocks */
+	bool		sorted;			/* blocks sorted and without duplicates? */
+	BlockNumber *blocks;
+} BlockRefEntry;
+
+typedef struct BlockRefTable
+{
+	HTAB	   *hash;
+	MemoryContext cxt;
+} BlockRefTable;
+
+/* GUC options */
+extern bool summarize_wal;
+extern int	wal_summary_keep_time;
+
+extern void WalSummarizerMain(void) pg_attribute_noreturn();
+
+extern BlockRefTable *CreateBlockRefTable(void);
+extern void BlockRefTableMarkBlock(BlockRefTable *brtab, RelFileNode *rnode,
+					   ForkNumber forknum, BlockNumber blkno);
+extern void BlockRefTableSetLimit(BlockRefTable *brtab, RelFileNode *rnode,
+					  ForkNumber forknum, BlockNumber limit);
+extern BlockRefEntry *BlockRefTableLookup(BlockRefTable *brtab,
+					RelFileNode *rnode, ForkNumber forknum);
+extern BlockRefTable *LoadWalSummaries(XLogRecPtr startptr,
+				 XLogRecPtr endptr);
+
+#endif   /* _WALSUMMARIZER_H */
@@ -0,0 +1,59 @@
+/*-------------------------------------------------------------------------
+ *
+ * walsummary.h
+ *	  Format of the WAL summary files written by the WAL summarizer.
+ *
+ * This file is included by frontend programs that read the summaries, such
+ * as pg_rewind, so it mustn't include any backend-only headers.
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ *
+ * src/include/postmaster/walsummary.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef _WALSUMMARY_H
+#define _WALSUMMARY_H
+
+#include "access/xlogdefs.h"
+#include "storage/block.h"
+#include "storage/relfilenode.h"
+
+/* Directory holding the summary files, relative to the data directory */
+#define WAL_SUMMARY_DIR		XLOGDIR "/summaries"
+
+#define WAL_SUMMARY_MAGIC		0x50475753		/* "PGWS" */
+#define WAL_SUMMARY_VERSION		1
+
+/*
+ * A summary file is named after the start and end of the WAL it covers,
+ * "%08X%08X%08X%08X.summary", and holds a WalSummaryFileHeader, then for
+ * each relation fork a WalSummaryEntry followed by its nblocks modified
+ * block numbers in ascending order, then a CRC-32C of all that.
+ *
+ * 'endptr' is the end of the last record summarized, so the summary that
+ * follows starts there.
+ */
+typedef struct WalSummaryFileHeader
+{
+	uint32		magic;			/* WAL_SUMMARY_MAGIC */
+	uint32		version;		/* WAL_SUMMARY_VERSION */
+	XLogRecPtr	startptr;		/* first record summarized */
+	XLogRecPtr	endptr;			/* end of the last record summarized */
+	uint32		nentries;		/* number of WalSummaryEntry */
+} WalSummaryFileHeader;
+
+/*
+ * Blocks at or past 'limit' are all to be considered modified, because the
+ * fork was created or truncated there.  An entry with relNode InvalidOid
+ * and limit 0 marks a whole database as created.
+ */
+typedef struct WalSummaryEntry
+{
+	RelFileNode rnode;
+	int32		forknum;
+	BlockNumber limit;			/* InvalidBlockNumber if none */
+	uint32		nblocks;
+} WalSummaryEntry;
+
+#endif   /* _WALSUMMARY_H */
@@ -20,6 +20,32 @@
 #define MAX_RATE_LOWER	32
 #define MAX_RATE_UPPER	1048576
 
+/*
+ * In an incremental base backup, each data file of a relation's main fork
+ * is sent as a tar member named after the file plus INCREMENTAL_FILE_SUFFIX,
+ * containing an IncrementalFileHeader, then the numbers of the blocks sent
+ * as uint32s in ascending order, then the contents of those blocks.  All
+ * integers are in network byte order.  The blocks not sent haven't changed
+ * since the LSN given in the INCREMENTAL option.
+ *
+ * With INCREMENTAL_FILE_SUMMARIZED, the blocks to send were taken from the
+ * WAL summaries rather than from the page LSNs; then the blocks not sent
+ * past the previous end of the file are known to be all zeros.
+ */
+#define INCREMENTAL_FILE_SUFFIX		".incremental"
+#define INCREMENTAL_FILE_MAGIC		0x50474942	/* "PGIB" */
+
+typedef struct IncrementalFileHeader
+{
+	uint32		magic;			/* INCREMENTAL_FILE_MAGIC */
+	uint32		blcksz;			/* BLCKSZ of the server */
+	uint32		nblocks;		/* length of the whole file, in blocks */
+	uint32		nsent;			/* number of blocks sent */
+	uint32		flags;			/* INCREMENTAL_FILE_* flags below */
+} IncrementalFileHeader;
+
+#define INCREMENTAL_FILE_SUMMARIZED	0x0001
+
 
 typedef struct
 {
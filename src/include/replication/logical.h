@@ -40,6 +40,13 @@ typedef struct LogicalDecodingContext
 	OutputPluginCallbacks callbacks;
 	OutputPluginOptions options;
 
+	/*
+	 * Does the output plugin want large in-progress transactions streamed
+	 * to it?  Set if it provides the stream callbacks, the plugin's startup
+	 * callback may clear it.
+	 */
+	bool		streaming;
+
 	/*
 	 * User specified options
 	 */
@@ -87,6 +87,49 @@ typedef void (*LogicalDecodeShutdownCB) (
 											  struct LogicalDecodingContext *
 );
 
+/*
+ * Called when a block of changes of an in-progress transaction is about to
+ * be streamed.  The transaction hasn't been streamed before if
+ * txn->streamed is false.
+ */
+typedef void (*LogicalDecodeStreamStartCB) (
+											 struct LogicalDecodingContext *,
+													   ReorderBufferTXN *txn);
+
+/*
+ * Called after a block of changes of an in-progress transaction has been
+ * streamed.
+ */
+typedef void (*LogicalDecodeStreamStopCB) (
+											 struct LogicalDecodingContext *,
+													  ReorderBufferTXN *txn);
+
+/*
+ * Called when a (sub-)transaction whose changes have been streamed aborted.
+ */
+typedef void (*LogicalDecodeStreamAbortCB) (
+											 struct LogicalDecodingContext *,
+													   ReorderBufferTXN *txn,
+													   XLogRecPtr abort_lsn);
+
+/*
+ * Called when a transaction whose changes have been streamed committed.
+ */
+typedef void (*LogicalDecodeStreamCommitCB) (
+											 struct LogicalDecodingContext *,
+														ReorderBufferTXN *txn,
+													   XLogRecPtr commit_lsn);
+
+/*
+ * Callback for every individual change of a streamed transaction.
+ */
+typedef void (*LogicalDecodeStreamChangeCB) (
+											 struct LogicalDecodingContext *,
+														ReorderBufferTXN *txn,
+														Relation relation,
+												 ReorderBufferChange *change
+);
+
 /*
  * Output plugin callbacks
  */
@@ -98,6 +141,12 @@ typedef struct OutputPluginCallbacks
 	LogicalDecodeCommitCB commit_cb;
 	LogicalDecodeFilterByOriginCB filter_by_origin_cb;
 	LogicalDecodeShutdownCB shutdown_cb;
+	/* streaming of in-progress transactions, optional */
+	LogicalDecodeStreamStartCB stream_start_cb;
+	LogicalDecodeStreamStopCB stream_stop_cb;
+	LogicalDecodeStreamAbortCB stream_abort_cb;
+	LogicalDecodeStreamCommitCB stream_commit_cb;
+	LogicalDecodeStreamChangeCB stream_change_cb;
 } OutputPluginCallbacks;
 
 void		OutputPluginPrepareWrite(struct LogicalDecodingContext *ctx, bool last_write);
@@ -20,12 +20,12 @@
 #include "utils/snapshot.h"
 #include "utils/timestamp.h"
 
+/* GUC variables */
+extern PGDLLIMPORT int logical_decoding_work_mem;
+
 /* an individual tuple, stored in one chunk of memory */
 typedef struct ReorderBufferTupleBuf
 {
-	/* position in preallocated list */
-	slist_node	node;
-
 	/* tuple, stored sequentially */
 	HeapTupleData tuple;
 	union
@@ -77,6 +77,9 @@ typedef struct ReorderBufferChange
 
 	RepOriginId origin_id;
 
+	/* Transaction this change belongs to, NULL until it is queued. */
+	struct ReorderBufferTXN *txn;
+
 	/*
 	 * Context data for the change, which part of the union is valid depends
 	 * on action/action_internal.
@@ -143,6 +146,19 @@ typedef struct ReorderBufferTXN
 	 */
 	bool		is_known_as_subxact;
 
+	/* The toplevel transaction, if this is known to be a subxact. */
+	struct ReorderBufferTXN *toptxn;
+
+	/* Have changes of this transaction been spilled to disk? */
+	bool		serialized;
+
+	/*
+	 * Have some of the changes of this transaction already been passed to the
+	 * output plugin, before the transaction finished?  See
+	 * ReorderBufferStreamTXN().
+	 */
+	bool		streamed;
+
 	/*
 	 * LSN of the first data carrying, WAL record with knowledge about this
 	 * xid. This is allowed to *not* be first record adorned with this xid, if
@@ -190,6 +206,13 @@ typedef struct ReorderBufferTXN
 	Snapshot	base_snapshot;
 	XLogRecPtr	base_snapshot_lsn;
 
+	/*
+	 * Snapshot and command id to continue decoding with, after some of the
+	 * changes have been streamed.  NULL if the base snapshot is still valid.
+	 */
+	Snapshot	snapshot_now;
+	CommandId	command_id;
+
 	/*
 	 * How many ReorderBufferChange's do we have in this txn.
 	 *
@@ -203,6 +226,12 @@ typedef struct ReorderBufferTXN
 	 */
 	uint64		nentries_mem;
 
+	/*
+	 * Memory used by the changes kept in memory (see ReorderBufferChangeSize).
+	 * Changes in subtransactions are not included.
+	 */
+	Size		size;
+
 	/*
 	 * List of ReorderBufferChange structs, including new Snapshots and new
 	 * CommandIds
@@ -274,6 +303,28 @@ typedef void (*ReorderBufferCommitCB) (
 												   ReorderBufferTXN *txn,
 												   XLogRecPtr commit_lsn);
 
+/* start streaming transaction callback signature */
+typedef void (*ReorderBufferStreamStartCB) (
+														ReorderBuffer *rb,
+														ReorderBufferTXN *txn);
+
+/* stop streaming transaction callback signature */
+typedef void (*ReorderBufferStreamStopCB) (
+													   ReorderBuffer *rb,
+													   ReorderBufferTXN *txn);
+
+/* discard streamed transaction callback signature */
+typedef void (*ReorderBufferStreamAbortCB) (
+														ReorderBuffer *rb,
+														ReorderBufferTXN *txn,
+													  XLogRecPtr abort_lsn);
+
+/* commit streamed transaction callback signature */
+typedef void (*ReorderBufferStreamCommitCB) (
+														 ReorderBuffer *rb,
+														 ReorderBufferTXN *txn,
+													 XLogRecPtr commit_lsn);
+
 struct ReorderBuffer
 {
 	/*
@@ -301,6 +352,16 @@ struct ReorderBuffer
 	ReorderBufferApplyChangeCB apply_change;
 	ReorderBufferCommitCB commit;
 
+	/*
+	 * Callbacks to be called when streaming in-progress transactions.  Only
+	 * used if the output plugin supports it, see ReorderBufferCanStream().
+	 */
+	ReorderBufferStreamStartCB stream_start;
+	ReorderBufferStreamStopCB stream_stop;
+	ReorderBufferStreamAbortCB stream_abort;
+	ReorderBufferStreamCommitCB stream_commit;
+	ReorderBufferApplyChangeCB stream_change;
+
 	/*
 	 * Pointer that will be passed untouched to the callbacks.
 	 */
@@ -312,32 +373,23 @@ struct ReorderBuffer
 	MemoryContext context;
 
 	/*
-	 * Data structure slab cache.
-	 *
-	 * We allocate/deallocate some structures very frequently, to avoid bigger
-	 * overhead we cache some unused ones here.
-	 *
-	 * The maximum number of cached entries is controlled by const variables
-	 * ontop of reorderbuffer.c
+	 * Memory contexts for specific types of objects, which are allocated and
+	 * freed very frequently: slab contexts for the fixed-size changes and
+	 * transactions, and a generation context for the tuples, which are
+	 * released in about the order they were decoded.
 	 */
-
-	/* cached ReorderBufferTXNs */
-	dlist_head	cached_transactions;
-	Size		nr_cached_transactions;
-
-	/* cached ReorderBufferChanges */
-	dlist_head	cached_changes;
-	Size		nr_cached_changes;
-
-	/* cached ReorderBufferTupleBufs */
-	slist_head	cached_tuplebufs;
-	Size		nr_cached_tuplebufs;
+	MemoryContext change_context;
+	MemoryContext txn_context;
+	MemoryContext tup_context;
 
 	XLogRecPtr	current_restart_decoding_lsn;
 
 	/* buffer for disk<->memory conversions */
 	char	   *outbuf;
 	Size		outbufsize;
+
+	/* memory used by the changes of all transactions */
+	Size		size;
 };
 
 
@@ -30,11 +30,29 @@
 
 typedef struct BufFile BufFile;
 
+/* Compression methods for temp_file_compression */
+typedef enum TempFileCompression
+{
+	TEMP_FILE_COMPRESSION_NONE = 0,
+	TEMP_FILE_COMPRESSION_PGLZ,
+	TEMP_FILE_COMPRESSION_LZ4,
+	TEMP_FILE_COMPRESSION_ZSTD
+} TempFileCompression;
+
+/* flags for BufFileCreateTempExtended */
+#define BUFFILE_WRITE_BEHIND	0x01	/* collect writes in a larger buffer */
+#define BUFFILE_COMPRESS		0x02	/* compress with temp_file_compression */
+
+/* GUC variables */
+extern int	temp_file_compression;
+extern int	temp_file_write_behind;
+
 /*
  * prototypes for functions in buffile.c
  */
 
 extern BufFile *BufFileCreateTemp(bool interXact);
+extern BufFile *BufFileCreateTempExtended(bool interXact, int flags);
 extern void BufFileClose(BufFile *file);
 extern size_t BufFileRead(BufFile *file, void *ptr, size_t size);
 extern size_t BufFileWrite(BufFile *file, void *ptr, size_t size);
@@ -45,6 +45,14 @@ typedef enum
 								 * replay; otherwise same as RBM_NORMAL */
 } ReadBufferMode;
 
+/* Possible values for numa_buffers */
+typedef enum
+{
+	NUMA_BUFFERS_OFF,			/* leave placement to the kernel */
+	NUMA_BUFFERS_INTERLEAVE,	/* spread memory evenly over all nodes */
+	NUMA_BUFFERS_PARTITION		/* one partition of buffers per node */
+} NumaBuffersType;
+
 /* in globals.c ... this duplicates miscadmin.h */
 extern PGDLLIMPORT int NBuffers;
 
@@ -54,6 +62,30 @@ extern int	bgwriter_lru_maxpages;
 extern double bgwriter_lru_multiplier;
 extern bool track_io_timing;
 extern int	target_prefetch_pages;
+extern int	checkpoint_flush_after;
+extern int	io_combine_limit;
+
+/* in buf_init.c */
+extern int	numa_buffers;
+
+/* upper limit for checkpoint_flush_after */
+#define WRITEBACK_MAX_PENDING_FLUSHES 256
+
+/* only issue writeback requests by default where they are cheap hints */
+#ifdef HAVE_SYNC_FILE_RANGE
+#define DEFAULT_CHECKPOINT_FLUSH_AFTER 32
+#else
+#define DEFAULT_CHECKPOINT_FLUSH_AFTER 0
+#endif
+
+/*
+ * Upper limit on the number of blocks ReadBuffersExtended reads at once,
+ * and so on io_combine_limit; also bounds smgrreadv and smgrwritev calls
+ */
+#define MAX_IO_COMBINE_BLOCKS	32
+
+/* how many blocks sequential scans read with one system call by default */
+#define DEFAULT_IO_COMBINE_LIMIT 16
 
 /* in buf_init.c */
 extern PGDLLIMPORT char *BufferBlocks;
@@ -144,12 +176,20 @@ extern PGDLLIMPORT int32 *LocalRefCount;
 /*
  * prototypes for functions in bufmgr.c
  */
+#ifdef USE_PREFETCH
+struct SMgrRelationData;
+extern bool PrefetchSharedBuffer(struct SMgrRelationData *smgr_reln,
+					 ForkNumber forkNum, BlockNumber blockNum);
+#endif
 extern void PrefetchBuffer(Relation reln, ForkNumber forkNum,
 			   BlockNumber blockNum);
 extern Buffer ReadBuffer(Relation reln, BlockNumber blockNum);
 extern Buffer ReadBufferExtended(Relation reln, ForkNumber forkNum,
 				   BlockNumber blockNum, ReadBufferMode mode,
 				   BufferAccessStrategy strategy);
+extern void ReadBuffersExtended(Relation reln, ForkNumber forkNum,
+					BlockNumber blockNum, int nblocks,
+					BufferAccessStrategy strategy, Buffer *buffers);
 extern Buffer ReadBufferWithoutRelcache(RelFileNode rnode,
 						  ForkNumber forkNum, BlockNumber blockNum,
 						  ReadBufferMode mode, BufferAccessStrategy strategy);
@@ -171,9 +211,10 @@ extern BlockNumber RelationGetNumberOfBlocksInFork(Relation relation,
 								ForkNumber forkNum);
 extern void FlushRelationBuffers(Relation rel);
 extern void FlushDatabaseBuffers(Oid dbid);
-extern void DropRelFileNodeBuffers(RelFileNodeBackend rnode,
+extern void DropRelFileNodeBuffers(struct SMgrRelationData *smgr_reln,
 					   ForkNumber forkNum, BlockNumber firstDelBlock);
-extern void DropRelFileNodesAllBuffers(RelFileNodeBackend *rnodes, int nnodes);
+extern void DropRelFileNodesAllBuffers(struct SMgrRelationData **smgr_reln,
+						   int nnodes);
 extern void DropDatabaseBuffers(Oid dbid);
 
 #define RelationGetNumberOfBlocks(reln) \
@@ -21,4 +21,13 @@
  */
 extern uint16 pg_checksum_page(char *page, BlockNumber blkno);
 
+/*
+ * Versions of pg_checksum_page compiled for SSE 4.1 and AVX2, which
+ * pg_checksum_page chooses from at runtime.
+ */
+#ifdef USE_SIMD_CHECKSUM_WITH_RUNTIME_CHECK
+extern uint16 pg_checksum_page_sse41(char *page, BlockNumber blkno);
+extern uint16 pg_checksum_page_avx2(char *page, BlockNumber blkno);
+#endif
+
 #endif   /* CHECKSUM_H */
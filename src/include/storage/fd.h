@@ -40,6 +40,9 @@
 #define FD_H
 
 #include <dirent.h>
+#ifndef WIN32
+#include <sys/uio.h>
+#endif
 
 
 /*
@@ -69,8 +72,12 @@ extern File PathNameOpenFile(FileName fileName, int fileFlags, int fileMode);
 extern File OpenTemporaryFile(bool interXact);
 extern void FileClose(File file);
 extern int	FilePrefetch(File file, off_t offset, int amount);
+extern void FileWriteback(File file, off_t offset, off_t nbytes);
+extern void FilePreallocate(File file, off_t offset, off_t nbytes);
 extern int	FileRead(File file, char *buffer, int amount);
 extern int	FileWrite(File file, char *buffer, int amount);
+extern int	FileReadV(File file, const struct iovec * iov, int iovcnt);
+extern int	FileWriteV(File file, const struct iovec * iov, int iovcnt);
 extern int	FileSync(File file);
 extern off_t FileSeek(File file, off_t offset, int whence);
 extern int	FileTruncate(File file, off_t offset);
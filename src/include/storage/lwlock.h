@@ -193,6 +193,28 @@ extern Size LWLockShmemSize(void);
 extern void CreateLWLocks(void);
 extern void InitLWLockAccess(void);
 
+/*
+ * Cumulative contention statistics, kept for each individual lock and lock
+ * partition in the main array and for each tranche.
+ */
+typedef struct LWLockStatsCounters
+{
+	uint64		sh_acquire_count;	/* shared-mode acquisitions */
+	uint64		ex_acquire_count;	/* exclusive-mode acquisitions */
+	uint64		block_count;	/* times we had to sleep */
+	uint64		wait_time;		/* total time slept, in microseconds */
+	uint64		spin_delay_count;		/* spin delays on the wait list mutex */
+} LWLockStatsCounters;
+
+typedef struct LWLockStatsData
+{
+	const char *name;			/* lock or tranche name */
+	int			partition;		/* partition number, or -1 */
+	LWLockStatsCounters counters;
+} LWLockStatsData;
+
+extern LWLockStatsData *GetLWLockStatsData(int *nelements);
+
 /*
  * The traditional method for obtaining an lwlock for use by an extension is
  * to call RequestAddinLWLocks() during postmaster startup; this will reserve
@@ -219,6 +241,8 @@ extern int	LWLockNewTrancheId(void);
 extern void LWLockRegisterTranche(int tranche_id, LWLockTranche *tranche);
 extern void LWLockInitialize(LWLock *lock, int tranche_id);
 
+extern const char *GetLWLockIdentifier(uint32 classId, uint16 eventId);
+
 /*
  * Prior to PostgreSQL 9.4, we used an enum type called LWLockId to refer
  * to LWLocks.  New code should instead use LWLock *.  However, for the
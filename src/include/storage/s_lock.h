@@ -978,4 +978,26 @@ extern int s_lock(volatile slock_t *lock, const char *file, int line);
 extern void set_spins_per_delay(int shared_spins_per_delay);
 extern int	update_spins_per_delay(int shared_spins_per_delay);
 
+/*
+ * Support for spin delay which is useful in various places where
+ * spinlock-like procedures take place.
+ */
+typedef struct
+{
+	int			spins;
+	int			delays;
+	int			cur_delay;
+	void	   *ptr;
+	const char *file;
+	int			line;
+} SpinDelayStatus;
+
+#define init_spin_delay(status, lockptr) \
+	((status)->spins = 0, (status)->delays = 0, (status)->cur_delay = 0, \
+	 (status)->ptr = (void *) (lockptr), \
+	 (status)->file = __FILE__, (status)->line = __LINE__)
+
+extern void perform_spin_delay(SpinDelayStatus *status);
+extern void finish_spin_delay(SpinDelayStatus *status);
+
 #endif	 /* S_LOCK_H */
@@ -22,6 +22,7 @@
 
 #include "access/htup.h"
 #include "access/skey.h"
+#include "fmgr.h"
 #include "lib/ilist.h"
 #include "utils/relcache.h"
 
@@ -52,7 +53,6 @@ typedef struct catcache
 												 * heap scans */
 	bool		cc_isname[CATCACHE_MAXKEYS];	/* flag "name" key columns */
 	dlist_head	cc_lists;		/* list of CatCList structs */
-#ifdef CATCACHE_STATS
 	long		cc_searches;	/* total # searches against this cache */
 	long		cc_hits;		/* # of matches against existing entry */
 	long		cc_neg_hits;	/* # of matches against negative entry */
@@ -65,7 +65,7 @@ typedef struct catcache
 	long		cc_invals;		/* # of entries invalidated from cache */
 	long		cc_lsearches;	/* total # list-searches */
 	long		cc_lhits;		/* # of matches against existing lists */
-#endif
+	long		cc_evictions;	/* # of entries evicted to save memory */
 	dlist_head *cc_bucket;		/* hash buckets */
 } CatCache;
 
@@ -83,6 +83,13 @@ typedef struct catctup
 	 */
 	dlist_node	cache_elem;		/* list member of per-bucket list */
 
+	/*
+	 * Each tuple is also a member of the global LRU list of all cache
+	 * entries, used to choose entries to evict when catalog_cache_limit is
+	 * exceeded.
+	 */
+	dlist_node	lru_elem;		/* list member of global LRU list */
+
 	/*
 	 * The tuple may also be a member of at most one CatCList.  (If a single
 	 * catcache is list-searched with varying numbers of keys, we may have to
@@ -155,9 +162,15 @@ typedef struct catcacheheader
 {
 	slist_head	ch_caches;		/* head of list of CatCache structs */
 	int			ch_ntup;		/* # of tuples in all caches */
+	Size		ch_nbytes;		/* memory used by tuples in all caches */
+	dlist_head	ch_lru;			/* all tuples, most recently used first */
 } CatCacheHeader;
 
 
+/* GUC variable: limit on ch_nbytes, in kilobytes, or 0 for no limit */
+extern int	catalog_cache_limit;
+
+
 /* this extern duplicates utils/memutils.h... */
 extern PGDLLIMPORT MemoryContext CacheMemoryContext;
 
@@ -192,6 +205,8 @@ extern void PrepareToInvalidateCacheTuple(Relation relation,
 							  void (*function) (int, uint32, Oid));
 
 extern void PrintCatCacheLeakWarning(HeapTuple tuple);
+
+extern Datum pg_stat_get_catcache(PG_FUNCTION_ARGS);
 extern void PrintCatCacheListLeakWarning(CatCList *list);
 
 #endif   /* CATCACHE_H */
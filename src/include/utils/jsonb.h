@@ -417,6 +417,8 @@ extern JsonbValue *findJsonbValueFromContainer(JsonbContainer *sheader,
 							JsonbValue *key);
 extern JsonbValue *getIthJsonbValueFromContainer(JsonbContainer *sheader,
 							  uint32 i);
+extern int findJsonbObjectKeyIndex(JsonbContainer *container,
+						char *key, uint32 keylen);
 extern JsonbValue *pushJsonbValue(JsonbParseState **pstate,
 			   JsonbIteratorToken seq, JsonbValue *jbVal);
 extern JsonbIterator *JsonbIteratorInit(JsonbContainer *container);
@@ -15,6 +15,7 @@
 #define _PG_NUMERIC_H_
 
 #include "fmgr.h"
+#include "lib/stringinfo.h"
 
 /*
  * Hardcoded precision limit - arbitrary, but must be small enough that
@@ -59,5 +60,6 @@ extern bool numeric_is_nan(Numeric num);
 int32		numeric_maximum_size(int32 typmod);
 extern char *numeric_out_sci(Numeric num, int scale);
 extern char *numeric_normalize(Numeric num);
+extern void numeric_send_direct(StringInfo buf, Datum value);
 
 #endif   /* _PG_NUMERIC_H_ */
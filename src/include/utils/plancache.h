@@ -21,6 +21,30 @@
 #define CACHEDPLANSOURCE_MAGIC		195726186
 #define CACHEDPLAN_MAGIC			953717834
 
+/* possible values for plan_cache_mode */
+typedef enum
+{
+	PLAN_CACHE_MODE_AUTO,
+	PLAN_CACHE_MODE_FORCE_GENERIC_PLAN,
+	PLAN_CACHE_MODE_FORCE_CUSTOM_PLAN
+}	PlanCacheMode;
+
+/* GUC parameter */
+extern int	plan_cache_mode;
+
+/* Most parameter classes tracked per CachedPlanSource */
+#define CACHEDPLAN_MAX_CLASSES		8
+
+/*
+ * Custom plan costs for one class of parameter values (see plancache.c).
+ */
+typedef struct CachedPlanClass
+{
+	uint32		param_class;	/* class identifier */
+	double		total_custom_cost;		/* total cost of custom plans so far */
+	int			num_custom_plans;		/* number of plans included in total */
+} CachedPlanClass;
+
 /*
  * CachedPlanSource (which might better have been called CachedQuery)
  * represents a SQL query that we expect to use multiple times.  It stores
@@ -109,6 +133,8 @@ typedef struct CachedPlanSource
 	double		generic_cost;	/* cost of generic plan, or -1 if not known */
 	double		total_custom_cost;		/* total cost of custom plans so far */
 	int			num_custom_plans;		/* number of plans included in total */
+	int			num_classes;	/* number of valid entries in classes[] */
+	CachedPlanClass classes[CACHEDPLAN_MAX_CLASSES];	/* the same, by class */
 	bool		hasRowSecurity; /* planned with row security? */
 	int			row_security_env;		/* row security setting when planned */
 	bool		rowSecurityDisabled;	/* is row security disabled? */
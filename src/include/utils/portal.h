@@ -221,5 +221,6 @@ extern Node *PortalListGetPrimaryStmt(List *stmts);
 extern void PortalCreateHoldStore(Portal portal);
 extern void PortalHashTableDeleteAll(void);
 extern bool ThereAreNoReadyPortals(void);
+extern bool ThereAreHoldablePortals(void);
 
 #endif   /* PORTAL_H */
@@ -117,6 +117,10 @@ typedef struct RelationData
 	Bitmapset  *rd_keyattr;		/* cols that can be ref'd by foreign keys */
 	Bitmapset  *rd_idattr;		/* included in replica identity index */
 
+	/* data managed by RelationGetCheckConstraintExprs: */
+	List	   *rd_checkexprs;	/* simplified CHECK constraints, if any */
+	MemoryContext rd_checkcxt;	/* private memory cxt for rd_checkexprs */
+
 	/*
 	 * rd_options is set whenever rd_rel is loaded into the relcache entry.
 	 * Note that you can NOT look into rd_rel for this data.  NULL means "use
@@ -350,6 +354,15 @@ typedef struct ViewOptions
  */
 #define RelationGetNumberOfAttributes(relation) ((relation)->rd_rel->relnatts)
 
+/*
+ * IndexRelationGetNumberOfKeyAttributes
+ *		Returns the number of key attributes in an index.  Any attributes
+ *		after those are non-key INCLUDE columns, which have no opclass and
+ *		take no part in ordering or uniqueness.
+ */
+#define IndexRelationGetNumberOfKeyAttributes(relation) \
+	((relation)->rd_index->indnkeyatts)
+
 /*
  * RelationGetDescr
  *		Returns tuple descriptor for a relation.
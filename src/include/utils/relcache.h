@@ -42,6 +42,7 @@ extern Oid	RelationGetOidIndex(Relation relation);
 extern Oid	RelationGetReplicaIndex(Relation relation);
 extern List *RelationGetIndexExpressions(Relation relation);
 extern List *RelationGetIndexPredicate(Relation relation);
+extern List *RelationGetCheckConstraintExprs(Relation relation);
 
 typedef enum IndexAttrBitmapKind
 {
@@ -120,6 +121,9 @@ extern void RelationCacheInitFilePreInvalidate(void);
 extern void RelationCacheInitFilePostInvalidate(void);
 extern void RelationCacheInitFileRemove(void);
 
+/* GUC variable */
+extern int	relation_cache_limit;
+
 /* should be used only by relcache.c and catcache.c */
 extern bool criticalRelcachesBuilt;
 
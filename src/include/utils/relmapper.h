@@ -55,6 +55,9 @@ extern void CheckPointRelationMap(void);
 
 extern void RelationMapFinishBootstrap(void);
 
+extern void RelationMapCopy(Oid dbid, Oid tsid, char *srcdbpath,
+				char *dstdbpath);
+
 extern void RelationMapInitialize(void);
 extern void RelationMapInitializePhase2(void);
 extern void RelationMapInitializePhase3(void);
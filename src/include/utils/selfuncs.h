@@ -186,6 +186,8 @@ extern void mergejoinscansel(PlannerInfo *root, Node *clause,
 
 extern double estimate_num_groups(PlannerInfo *root, List *groupExprs,
 					double input_rows, List **pgset);
+extern bool get_index_group_stats(Oid indexoid, int indexcol,
+					  double *ndistinct, Selectivity *degree);
 
 extern Selectivity estimate_hash_bucketsize(PlannerInfo *root, Node *hashkey,
 						 double nbuckets);
@@ -0,0 +1,35 @@
+/*-------------------------------------------------------------------------
+ *
+ * sessionstate.h
+ *	  Tracking of session state that ties a client to its backend.
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * src/include/utils/sessionstate.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef SESSIONSTATE_H
+#define SESSIONSTATE_H
+
+#include "fmgr.h"
+
+/*
+ * Kinds of state that outlive a transaction.  A session holding none of
+ * these could be handed to another client of the same user and database at
+ * a transaction boundary without anyone noticing.
+ */
+#define SESSION_STATE_TEMP_OBJECTS		0x0001	/* temp namespace in use */
+#define SESSION_STATE_PREPARED_STMTS	0x0002	/* PREPARE'd statements */
+#define SESSION_STATE_HOLD_CURSORS		0x0004	/* WITH HOLD cursors */
+#define SESSION_STATE_LISTEN			0x0008	/* LISTEN channels */
+#define SESSION_STATE_ADVISORY_LOCKS	0x0010	/* session advisory locks */
+#define SESSION_STATE_SETTINGS			0x0020	/* options changed by SET */
+#define SESSION_STATE_ROLE				0x0040	/* SET ROLE/SESSION AUTH */
+
+extern int	GetSessionState(void);
+
+extern Datum pg_session_state(PG_FUNCTION_ARGS);
+
+#endif   /* SESSIONSTATE_H */
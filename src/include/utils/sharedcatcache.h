@@ -0,0 +1,41 @@
+/*-------------------------------------------------------------------------
+ *
+ * sharedcatcache.h
+ *	  Shared-memory catalog tuple cache.
+ *
+ * The shared catalog cache sits behind each backend's local catcache and
+ * holds copies of recently loaded catalog tuples, so that a backend which
+ * misses its own cache can often avoid scanning the catalog.  See
+ * src/backend/utils/cache/sharedcatcache.c.
+ *
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * src/include/utils/sharedcatcache.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef SHAREDCATCACHE_H
+#define SHAREDCATCACHE_H
+
+#include "access/htup.h"
+#include "storage/sinval.h"
+
+/* GUC variable, in kilobytes; zero disables the shared cache */
+extern int	shared_catcache_size;
+
+extern Size SharedCatCacheShmemSize(void);
+extern void SharedCatCacheShmemInit(void);
+
+extern bool SharedCatCacheUsable(void);
+extern HeapTuple SharedCatCacheLookup(int cacheId, Oid dbId, uint32 hashValue,
+					 uint64 *generation);
+extern void SharedCatCacheInsert(int cacheId, Oid dbId, uint32 hashValue,
+					 HeapTuple tuple, uint64 generation);
+
+extern void SharedCatCacheProcessMessages(const SharedInvalidationMessage *msgs,
+							  int n);
+extern void SharedCatCacheInvalidateDatabase(Oid dbId);
+
+#endif   /* SHAREDCATCACHE_H */
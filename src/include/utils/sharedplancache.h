@@ -0,0 +1,50 @@
+/*-------------------------------------------------------------------------
+ *
+ * sharedplancache.h
+ *	  Shared-memory cache of generic plans.
+ *
+ * The shared plan cache holds serialized copies of generic plans built by
+ * plancache.c, so that a backend preparing a statement some other backend
+ * has already planned can skip planning it.  See
+ * src/backend/utils/cache/sharedplancache.c.
+ *
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * src/include/utils/sharedplancache.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef SHAREDPLANCACHE_H
+#define SHAREDPLANCACHE_H
+
+#include "storage/sinval.h"
+#include "utils/plancache.h"
+
+/* GUC variable, in kilobytes; zero disables the shared plan cache */
+extern int	shared_plan_cache_size;
+
+/* Planning statistics kept with a shared plan, see plancache.c */
+typedef struct SharedPlanStats
+{
+	double		generic_cost;	/* cost of the generic plan */
+	double		total_custom_cost;		/* total cost of custom plans */
+	int			num_custom_plans;		/* number of plans included in total */
+} SharedPlanStats;
+
+extern Size SharedPlanCacheShmemSize(void);
+extern void SharedPlanCacheShmemInit(void);
+
+extern bool SharedPlanCacheUsable(void);
+extern uint64 SharedPlanCacheGeneration(void);
+extern bool SharedPlanCacheLookup(CachedPlanSource *plansource,
+					  SharedPlanStats *stats, List **stmt_list);
+extern void SharedPlanCacheInsert(CachedPlanSource *plansource,
+					  List *stmt_list, uint64 generation);
+
+extern void SharedPlanCacheProcessMessages(const SharedInvalidationMessage *msgs,
+							   int n);
+extern void SharedPlanCacheInvalidateDatabase(Oid dbId);
+
+#endif   /* SHAREDPLANCACHE_H */
@@ -0,0 +1,36 @@
+/*-------------------------------------------------------------------------
+ *
+ * sharedtsdict.h
+ *	  Shared-memory copies of text search dictionaries.
+ *
+ * Text search dictionaries of some templates can be built once in shared
+ * memory and then used by all backends, rather than being loaded by each
+ * backend separately.  See src/backend/utils/cache/sharedtsdict.c.
+ *
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * src/include/utils/sharedtsdict.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef SHAREDTSDICT_H
+#define SHAREDTSDICT_H
+
+#include "access/htup.h"
+#include "nodes/pg_list.h"
+
+/* GUC variable, in kilobytes; zero disables shared dictionaries */
+extern int	shared_ts_dictionary_size;
+
+/* true while a dictionary's init method is building it in shared memory */
+extern bool SharedTSDictBuilding;
+
+extern Size SharedTSDictShmemSize(void);
+extern void SharedTSDictShmemInit(void);
+
+extern void *SharedTSDictLoad(Oid dictId, HeapTuple dicttup, Oid initOid,
+				 List *dictoptions);
+
+#endif   /* SHAREDTSDICT_H */
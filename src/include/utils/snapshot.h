@@ -93,6 +93,12 @@ typedef struct SnapshotData
 
 	CommandId	curcid;			/* in my xact, CID < curcid are visible */
 
+	/*
+	 * Value of ShmemVariableCache->xactCompletionCount when the snapshot was
+	 * built by GetSnapshotData(), or 0 if the contents can't be reused.
+	 */
+	uint64		snapXactCompletionCount;
+
 	/*
 	 * An extra return value for HeapTupleSatisfiesDirty, not used in MVCC
 	 * snapshots.
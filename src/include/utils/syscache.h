@@ -125,6 +125,7 @@ extern Datum SysCacheGetAttr(int cacheId, HeapTuple tup,
 
 extern uint32 GetSysCacheHashValue(int cacheId,
 					 Datum key1, Datum key2, Datum key3, Datum key4);
+extern Oid	GetSysCacheRelationId(int cacheId);
 
 /* list-search interface.  Users of this must import catcache.h too */
 struct catclist;
@@ -2920,6 +2920,8 @@ freePGconn(PGconn *conn)
 		free(conn->outBuffer);
 	if (conn->rowBuf)
 		free(conn->rowBuf);
+	if (conn->batchBuf)
+		free(conn->batchBuf);
 	termPQExpBuffer(&conn->errorMessage);
 	termPQExpBuffer(&conn->workBuffer);
 
@@ -2975,6 +2977,17 @@ closePGconn(PGconn *conn)
 										 * absent */
 	conn->asyncStatus = PGASYNC_IDLE;
 	pqClearAsyncResult(conn);	/* deallocate result */
+	conn->pipelineStatus = PQ_PIPELINE_OFF;
+	while (conn->cmd_queue_head != NULL)
+	{
+		PGcmdQueueEntry *prev = conn->cmd_queue_head;
+
+		conn->cmd_queue_head = prev->next;
+		if (prev->query)
+			free(prev->query);
+		free(prev);
+	}
+	conn->cmd_queue_tail = NULL;
 	resetPQExpBuffer(&conn->errorMessage);
 	pg_freeaddrinfo_all(conn->addrlist_family, conn->addrlist);
 	conn->addrlist = NULL;
@@ -5395,6 +5408,14 @@ PQtransactionStatus(const PGconn *conn)
 	return conn->xactStatus;
 }
 
+PGpipelineStatus
+PQpipelineStatus(const PGconn *conn)
+{
+	if (!conn)
+		return PQ_PIPELINE_OFF;
+	return conn->pipelineStatus;
+}
+
 const char *
 PQparameterStatus(const PGconn *conn, const char *paramName)
 {
@@ -39,7 +39,9 @@ char	   *const pgresStatus[] = {
 	"PGRES_NONFATAL_ERROR",
 	"PGRES_FATAL_ERROR",
 	"PGRES_COPY_BOTH",
-	"PGRES_SINGLE_TUPLE"
+	"PGRES_SINGLE_TUPLE",
+	"PGRES_PIPELINE_SYNC",
+	"PGRES_PIPELINE_ABORTED"
 };
 
 /*
@@ -69,6 +71,11 @@ static PGresult *PQexecFinish(PGconn *conn);
 static int PQsendDescribe(PGconn *conn, char desc_type,
 			   const char *desc_target);
 static int	check_field_number(const PGresult *res, int field_num);
+static PGcmdQueueEntry *pqAllocCmdQueueEntry(PGconn *conn);
+static void pqAppendCmdQueueEntry(PGconn *conn, PGcmdQueueEntry *entry);
+static void pqCommandQueueAdvance(PGconn *conn);
+static void pqPipelineProcessQueue(PGconn *conn);
+static int	pqPipelineFlush(PGconn *conn);
 
 
 /* ----------------
@@ -180,6 +187,7 @@ PQmakeEmptyPGresult(PGconn *conn, ExecStatusType status)
 			case PGRES_COPY_IN:
 			case PGRES_COPY_BOTH:
 			case PGRES_SINGLE_TUPLE:
+			case PGRES_PIPELINE_SYNC:
 				/* non-error cases */
 				break;
 			default:
@@ -1123,6 +1131,17 @@ PQsendQuery(PGconn *conn, const char *query)
 		return 0;
 	}
 
+	/*
+	 * The simple Query protocol implies a Sync, so it cannot take part in a
+	 * pipeline; use PQsendQueryParams instead.
+	 */
+	if (conn->pipelineStatus != PQ_PIPELINE_OFF)
+	{
+		printfPQExpBuffer(&conn->errorMessage,
+			   libpq_gettext("PQsendQuery not allowed in pipeline mode\n"));
+		return 0;
+	}
+
 	/* construct the outgoing Query message */
 	if (pqPutMsgStart('Q', false, conn) < 0 ||
 		pqPuts(query, conn) < 0 ||
@@ -1210,6 +1229,8 @@ PQsendPrepare(PGconn *conn,
 			  const char *stmtName, const char *query,
 			  int nParams, const Oid *paramTypes)
 {
+	PGcmdQueueEntry *entry = NULL;
+
 	if (!PQsendQueryStart(conn))
 		return 0;
 
@@ -1241,6 +1262,13 @@ PQsendPrepare(PGconn *conn,
 		return 0;
 	}
 
+	if (conn->pipelineStatus != PQ_PIPELINE_OFF)
+	{
+		entry = pqAllocCmdQueueEntry(conn);
+		if (entry == NULL)
+			return 0;
+	}
+
 	/* construct the Parse message */
 	if (pqPutMsgStart('P', false, conn) < 0 ||
 		pqPuts(stmtName, conn) < 0 ||
@@ -1267,32 +1295,46 @@ PQsendPrepare(PGconn *conn,
 	if (pqPutMsgEnd(conn) < 0)
 		goto sendFailed;
 
-	/* construct the Sync message */
-	if (pqPutMsgStart('S', false, conn) < 0 ||
-		pqPutMsgEnd(conn) < 0)
-		goto sendFailed;
+	/* in pipeline mode, the Sync is sent by PQpipelineSync */
+	if (entry == NULL)
+	{
+		/* construct the Sync message */
+		if (pqPutMsgStart('S', false, conn) < 0 ||
+			pqPutMsgEnd(conn) < 0)
+			goto sendFailed;
 
-	/* remember we are doing just a Parse */
-	conn->queryclass = PGQUERY_PREPARE;
+		/* remember we are doing just a Parse */
+		conn->queryclass = PGQUERY_PREPARE;
 
-	/* and remember the query text too, if possible */
-	/* if insufficient memory, last_query just winds up NULL */
-	if (conn->last_query)
-		free(conn->last_query);
-	conn->last_query = strdup(query);
+		/* and remember the query text too, if possible */
+		/* if insufficient memory, last_query just winds up NULL */
+		if (conn->last_query)
+			free(conn->last_query);
+		conn->last_query = strdup(query);
+	}
+	else
+	{
+		entry->queryclass = PGQUERY_PREPARE;
+		entry->query = strdup(query);
+		pqAppendCmdQueueEntry(conn, entry);
+		entry = NULL;
+	}
 
 	/*
 	 * Give the data a push.  In nonblock mode, don't complain if we're unable
 	 * to send it all; PQgetResult() will do any additional flushing needed.
 	 */
-	if (pqFlush(conn) < 0)
+	if (pqPipelineFlush(conn) < 0)
 		goto sendFailed;
 
 	/* OK, it's launched! */
-	conn->asyncStatus = PGASYNC_BUSY;
+	if (conn->pipelineStatus == PQ_PIPELINE_OFF)
+		conn->asyncStatus = PGASYNC_BUSY;
 	return 1;
 
 sendFailed:
+	if (entry)
+		free(entry);
 	pqHandleSendFailure(conn);
 	return 0;
 }
@@ -1358,6 +1400,29 @@ PQsendQueryStart(PGconn *conn)
 						  libpq_gettext("no connection to the server\n"));
 		return false;
 	}
+	/*
+	 * In pipeline mode, commands may be queued up behind the ones in
+	 * progress, except while a COPY is running.
+	 */
+	if (conn->pipelineStatus != PQ_PIPELINE_OFF)
+	{
+		if (conn->asyncStatus == PGASYNC_COPY_IN ||
+			conn->asyncStatus == PGASYNC_COPY_OUT ||
+			conn->asyncStatus == PGASYNC_COPY_BOTH)
+		{
+			printfPQExpBuffer(&conn->errorMessage,
+				   libpq_gettext("cannot queue commands during COPY\n"));
+			return false;
+		}
+
+		/*
+		 * Result-accumulation state belongs to the command at the head of
+		 * the queue; pqPipelineProcessQueue resets it as each command
+		 * starts.
+		 */
+		return true;
+	}
+
 	/* Can't send while already busy, either. */
 	if (conn->asyncStatus != PGASYNC_IDLE)
 	{
@@ -1370,8 +1435,9 @@ PQsendQueryStart(PGconn *conn)
 	conn->result = NULL;
 	conn->next_result = NULL;
 
-	/* reset single-row processing mode */
+	/* reset single-row and row-batch processing modes */
 	conn->singleRowMode = false;
+	conn->rowBatchMode = false;
 
 	/* ready to send command message */
 	return true;
@@ -1395,6 +1461,7 @@ PQsendQueryGuts(PGconn *conn,
 				const int *paramFormats,
 				int resultFormat)
 {
+	PGcmdQueueEntry *entry = NULL;
 	int			i;
 
 	/* This isn't gonna work on a 2.0 server */
@@ -1405,9 +1472,17 @@ PQsendQueryGuts(PGconn *conn,
 		return 0;
 	}
 
+	if (conn->pipelineStatus != PQ_PIPELINE_OFF)
+	{
+		entry = pqAllocCmdQueueEntry(conn);
+		if (entry == NULL)
+			return 0;
+	}
+
 	/*
 	 * We will send Parse (if needed), Bind, Describe Portal, Execute, Sync,
-	 * using specified statement name and the unnamed portal.
+	 * using specified statement name and the unnamed portal.  In pipeline
+	 * mode the Sync is left to PQpipelineSync.
 	 */
 
 	if (command)
@@ -1517,35 +1592,48 @@ PQsendQueryGuts(PGconn *conn,
 		pqPutMsgEnd(conn) < 0)
 		goto sendFailed;
 
-	/* construct the Sync message */
-	if (pqPutMsgStart('S', false, conn) < 0 ||
-		pqPutMsgEnd(conn) < 0)
-		goto sendFailed;
+	if (entry == NULL)
+	{
+		/* construct the Sync message */
+		if (pqPutMsgStart('S', false, conn) < 0 ||
+			pqPutMsgEnd(conn) < 0)
+			goto sendFailed;
 
-	/* remember we are using extended query protocol */
-	conn->queryclass = PGQUERY_EXTENDED;
+		/* remember we are using extended query protocol */
+		conn->queryclass = PGQUERY_EXTENDED;
 
-	/* and remember the query text too, if possible */
-	/* if insufficient memory, last_query just winds up NULL */
-	if (conn->last_query)
-		free(conn->last_query);
-	if (command)
-		conn->last_query = strdup(command);
+		/* and remember the query text too, if possible */
+		/* if insufficient memory, last_query just winds up NULL */
+		if (conn->last_query)
+			free(conn->last_query);
+		if (command)
+			conn->last_query = strdup(command);
+		else
+			conn->last_query = NULL;
+	}
 	else
-		conn->last_query = NULL;
+	{
+		entry->queryclass = PGQUERY_EXTENDED;
+		entry->query = command ? strdup(command) : NULL;
+		pqAppendCmdQueueEntry(conn, entry);
+		entry = NULL;
+	}
 
 	/*
 	 * Give the data a push.  In nonblock mode, don't complain if we're unable
 	 * to send it all; PQgetResult() will do any additional flushing needed.
 	 */
-	if (pqFlush(conn) < 0)
+	if (pqPipelineFlush(conn) < 0)
 		goto sendFailed;
 
 	/* OK, it's launched! */
-	conn->asyncStatus = PGASYNC_BUSY;
+	if (conn->pipelineStatus == PQ_PIPELINE_OFF)
+		conn->asyncStatus = PGASYNC_BUSY;
 	return 1;
 
 sendFailed:
+	if (entry)
+		free(entry);
 	pqHandleSendFailure(conn);
 	return 0;
 }
@@ -1601,6 +1689,87 @@ PQsetSingleRowMode(PGconn *conn)
 	return 1;
 }
 
+/*
+ * PQgetRowBatch
+ *	  Fetch the next rows of the current query without copying them.
+ *
+ * Waits until at least one row is available, then returns the rows already
+ * received, up to maxrows (no limit if maxrows <= 0).  *values is set to an
+ * array of nrows * PQnfields(*res) values, row by row, pointing directly
+ * into the connection's input buffer; *res describes the columns, and owns
+ * no rows.  Both stay valid only until the next call of a libpq function
+ * on the connection, and must not be freed.
+ *
+ * Returns the number of rows, or 0 when there are no more rows to fetch this
+ * way; then PQgetResult must be called as usual to collect the query's
+ * final result and any error.
+ */
+int
+PQgetRowBatch(PGconn *conn, int maxrows, PGresult **res,
+			  PGdataValue **values)
+{
+	int			nrows;
+
+	if (!conn)
+		return 0;
+
+	/*
+	 * Rows can only be fetched while a query is running.  Over protocol 2.0
+	 * they are always delivered by PQgetResult.
+	 */
+	if (PG_PROTOCOL_MAJOR(conn->pversion) < 3 ||
+		conn->asyncStatus != PGASYNC_BUSY ||
+		(conn->queryclass != PGQUERY_SIMPLE &&
+		 conn->queryclass != PGQUERY_EXTENDED))
+	{
+		conn->rowBatchMode = false;
+		return 0;
+	}
+
+	/* Make the parser stop at data rows, leaving them for us */
+	conn->rowBatchMode = true;
+
+	for (;;)
+	{
+		int			flushResult;
+
+		/* Parse any available data up to the next row. */
+		parseInput(conn);
+		if (conn->asyncStatus != PGASYNC_BUSY)
+			break;
+
+		nrows = pqGetRowBatch3(conn, maxrows);
+		if (nrows > 0)
+		{
+			*res = conn->result;
+			*values = conn->batchBuf;
+			return nrows;
+		}
+		if (nrows < 0)
+			continue;			/* error set up; parse up to end of query */
+
+		/*
+		 * Nothing to return yet; send any unsent data and wait for more, as
+		 * PQgetResult does.  On failure, leave it to PQgetResult to report.
+		 */
+		while ((flushResult = pqFlush(conn)) > 0)
+		{
+			if (pqWait(FALSE, TRUE, conn))
+			{
+				flushResult = -1;
+				break;
+			}
+		}
+		if (flushResult ||
+			pqWait(TRUE, FALSE, conn) ||
+			pqReadData(conn) < 0)
+			break;
+	}
+
+	conn->rowBatchMode = false;
+	return 0;
+}
+
 /*
  * Consume any available input from the backend
  * 0 return: some kind of trouble
@@ -1685,6 +1854,9 @@ PQgetResult(PGconn *conn)
 	if (!conn)
 		return NULL;
 
+	/* Any rows not yet fetched by PQgetRowBatch go into the result. */
+	conn->rowBatchMode = false;
+
 	/* Parse any available data, if our state permits. */
 	parseInput(conn);
 
@@ -1732,8 +1904,30 @@ PQgetResult(PGconn *conn)
 			break;
 		case PGASYNC_READY:
 			res = pqPrepareAsyncResult(conn);
-			/* Set the state back to BUSY, allowing parsing to proceed. */
-			conn->asyncStatus = PGASYNC_BUSY;
+			if (conn->pipelineStatus == PQ_PIPELINE_OFF ||
+				(res && res->resultStatus == PGRES_SINGLE_TUPLE))
+			{
+				/* Set the state back to BUSY, allowing parsing to proceed. */
+				conn->asyncStatus = PGASYNC_BUSY;
+			}
+			else
+			{
+				/*
+				 * In pipeline mode the head command is now finished.  The
+				 * next call returns NULL to mark the end of its results,
+				 * except that nothing separates a sync point from what
+				 * follows it.
+				 */
+				pqCommandQueueAdvance(conn);
+				conn->asyncStatus = PGASYNC_PIPELINE_IDLE;
+				if (res && res->resultStatus == PGRES_PIPELINE_SYNC)
+					pqPipelineProcessQueue(conn);
+			}
+			break;
+		case PGASYNC_PIPELINE_IDLE:
+			/* end of a pipelined command's results; start the next one */
+			res = NULL;
+			pqPipelineProcessQueue(conn);
 			break;
 		case PGASYNC_COPY_IN:
 			res = getCopyResult(conn, PGRES_COPY_IN);
@@ -1911,6 +2105,13 @@ PQexecStart(PGconn *conn)
 	if (!conn)
 		return false;
 
+	if (conn->pipelineStatus != PQ_PIPELINE_OFF)
+	{
+		printfPQExpBuffer(&conn->errorMessage,
+						  libpq_gettext("synchronous command execution functions are not allowed in pipeline mode\n"));
+		return false;
+	}
+
 	/*
 	 * Silently discard any prior query result that application didn't eat.
 	 * This is probably poor design, but it's here for backward compatibility.
@@ -2105,6 +2306,8 @@ PQsendDescribePortal(PGconn *conn, const char *portal)
 static int
 PQsendDescribe(PGconn *conn, char desc_type, const char *desc_target)
 {
+	PGcmdQueueEntry *entry = NULL;
+
 	/* Treat null desc_target as empty string */
 	if (!desc_target)
 		desc_target = "";
@@ -2120,6 +2323,13 @@ PQsendDescribe(PGconn *conn, char desc_type, const char *desc_target)
 		return 0;
 	}
 
+	if (conn->pipelineStatus != PQ_PIPELINE_OFF)
+	{
+		entry = pqAllocCmdQueueEntry(conn);
+		if (entry == NULL)
+			return 0;
+	}
+
 	/* construct the Describe message */
 	if (pqPutMsgStart('D', false, conn) < 0 ||
 		pqPutc(desc_type, conn) < 0 ||
@@ -2127,37 +2337,340 @@ PQsendDescribe(PGconn *conn, char desc_type, const char *desc_target)
 		pqPutMsgEnd(conn) < 0)
 		goto sendFailed;
 
-	/* construct the Sync message */
-	if (pqPutMsgStart('S', false, conn) < 0 ||
-		pqPutMsgEnd(conn) < 0)
-		goto sendFailed;
+	if (entry == NULL)
+	{
+		/* construct the Sync message */
+		if (pqPutMsgStart('S', false, conn) < 0 ||
+			pqPutMsgEnd(conn) < 0)
+			goto sendFailed;
 
-	/* remember we are doing a Describe */
-	conn->queryclass = PGQUERY_DESCRIBE;
+		/* remember we are doing a Describe */
+		conn->queryclass = PGQUERY_DESCRIBE;
 
-	/* reset last-query string (not relevant now) */
-	if (conn->last_query)
+		/* reset last-query string (not relevant now) */
+		if (conn->last_query)
+		{
+			free(conn->last_query);
+			conn->last_query = NULL;
+		}
+	}
+	else
 	{
-		free(conn->last_query);
-		conn->last_query = NULL;
+		entry->queryclass = PGQUERY_DESCRIBE;
+		pqAppendCmdQueueEntry(conn, entry);
+		entry = NULL;
 	}
 
 	/*
 	 * Give the data a push.  In nonblock mode, don't complain if we're unable
 	 * to send it all; PQgetResult() will do any additional flushing needed.
 	 */
-	if (pqFlush(conn) < 0)
+	if (pqPipelineFlush(conn) < 0)
 		goto sendFailed;
 
 	/* OK, it's launched! */
-	conn->asyncStatus = PGASYNC_BUSY;
+	if (conn->pipelineStatus == PQ_PIPELINE_OFF)
+		conn->asyncStatus = PGASYNC_BUSY;
 	return 1;
 
 sendFailed:
+	if (entry)
+		free(entry);
 	pqHandleSendFailure(conn);
 	return 0;
 }
 
+/*
+ * PQenterPipelineMode
+ *	 Put the connection into pipeline mode.
+ *
+ * In pipeline mode, commands sent with PQsendQueryParams, PQsendPrepare,
+ * PQsendQueryPrepared and the PQsendDescribe functions are not followed by
+ * a Sync; they queue up and the application collects their results in order
+ * with PQgetResult, each command's results followed by a NULL.  PQpipelineSync
+ * sends a Sync, which establishes a synchronization point: if a command in
+ * the pipeline fails, the commands after it up to the next sync point are
+ * skipped by the server and reported as PGRES_PIPELINE_ABORTED.
+ *
+ * Returns 1 on success, 0 if the connection is not idle.
+ */
+int
+PQenterPipelineMode(PGconn *conn)
+{
+	if (!conn)
+		return 0;
+
+	/* succeed with no action if already in pipeline mode */
+	if (conn->pipelineStatus != PQ_PIPELINE_OFF)
+		return 1;
+
+	if (PG_PROTOCOL_MAJOR(conn->pversion) < 3)
+	{
+		printfPQExpBuffer(&conn->errorMessage,
+		 libpq_gettext("function requires at least protocol version 3.0\n"));
+		return 0;
+	}
+
+	if (conn->asyncStatus != PGASYNC_IDLE)
+	{
+		printfPQExpBuffer(&conn->errorMessage,
+						  libpq_gettext("cannot enter pipeline mode, connection not idle\n"));
+		return 0;
+	}
+
+	conn->pipelineStatus = PQ_PIPELINE_ON;
+	return 1;
+}
+
+/*
+ * PQexitPipelineMode
+ *	 Return the connection to normal mode.
+ *
+ * This is only possible once all results of the pipeline have been
+ * collected.  Returns 1 on success, 0 if commands remain in progress.
+ */
+int
+PQexitPipelineMode(PGconn *conn)
+{
+	if (!conn)
+		return 0;
+
+	if (conn->pipelineStatus == PQ_PIPELINE_OFF)
+		return 1;
+
+	if (conn->asyncStatus != PGASYNC_IDLE || conn->cmd_queue_head != NULL)
+	{
+		printfPQExpBuffer(&conn->errorMessage,
+						  libpq_gettext("cannot exit pipeline mode with uncollected results\n"));
+		return 0;
+	}
+
+	conn->pipelineStatus = PQ_PIPELINE_OFF;
+	return 1;
+}
+
+/*
+ * PQpipelineSync
+ *	 Send a Sync message, marking a synchronization point in the pipeline,
+ *	 and flush the output buffer.
+ *
+ * The sync point shows up as a PGRES_PIPELINE_SYNC result, once all results
+ * of the commands before it have been collected.
+ *
+ * Returns 1 on success, 0 on failure (conn->errorMessage is set).
+ */
+int
+PQpipelineSync(PGconn *conn)
+{
+	PGcmdQueueEntry *entry;
+
+	if (!conn)
+		return 0;
+
+	if (conn->pipelineStatus == PQ_PIPELINE_OFF)
+	{
+		printfPQExpBuffer(&conn->errorMessage,
+						  libpq_gettext("cannot send pipeline sync when not in pipeline mode\n"));
+		return 0;
+	}
+
+	if (!PQsendQueryStart(conn))
+		return 0;
+
+	entry = pqAllocCmdQueueEntry(conn);
+	if (entry == NULL)
+		return 0;
+
+	/* construct the Sync message */
+	if (pqPutMsgStart('S', false, conn) < 0 ||
+		pqPutMsgEnd(conn) < 0)
+	{
+		free(entry);
+		pqHandleSendFailure(conn);
+		return 0;
+	}
+
+	entry->queryclass = PGQUERY_SYNC;
+	pqAppendCmdQueueEntry(conn, entry);
+
+	/*
+	 * Give the data a push.  In nonblock mode, don't complain if we're unable
+	 * to send it all; PQgetResult() will do any additional flushing needed.
+	 */
+	if (pqFlush(conn) < 0)
+	{
+		pqHandleSendFailure(conn);
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * PQsendFlushRequest
+ *	 Ask the server to send any pending output without waiting for a Sync.
+ *
+ * The Flush message is only added to the output buffer; the application
+ * must still call PQflush, or send enough further commands, to get it sent.
+ *
+ * Returns 1 on success, 0 on failure (conn->errorMessage is set).
+ */
+int
+PQsendFlushRequest(PGconn *conn)
+{
+	if (!conn)
+		return 0;
+
+	/* Don't try to send if we know there's no live connection. */
+	if (conn->status != CONNECTION_OK)
+	{
+		printfPQExpBuffer(&conn->errorMessage,
+						  libpq_gettext("no connection to the server\n"));
+		return 0;
+	}
+
+	/* This isn't gonna work on a 2.0 server */
+	if (PG_PROTOCOL_MAJOR(conn->pversion) < 3)
+	{
+		printfPQExpBuffer(&conn->errorMessage,
+		 libpq_gettext("function requires at least protocol version 3.0\n"));
+		return 0;
+	}
+
+	/* construct the Flush message */
+	if (pqPutMsgStart('H', false, conn) < 0 ||
+		pqPutMsgEnd(conn) < 0)
+		return 0;
+
+	return 1;
+}
+
+/*
+ * pqAllocCmdQueueEntry
+ *	 Allocate an entry for the pipeline command queue.
+ *
+ * Returns NULL, with conn->errorMessage set, if out of memory.
+ */
+static PGcmdQueueEntry *
+pqAllocCmdQueueEntry(PGconn *conn)
+{
+	PGcmdQueueEntry *entry;
+
+	entry = (PGcmdQueueEntry *) malloc(sizeof(PGcmdQueueEntry));
+	if (entry == NULL)
+	{
+		printfPQExpBuffer(&conn->errorMessage,
+						  libpq_gettext("out of memory\n"));
+		return NULL;
+	}
+	entry->queryclass = PGQUERY_EXTENDED;
+	entry->query = NULL;
+	entry->next = NULL;
+	return entry;
+}
+
+/*
+ * pqAppendCmdQueueEntry
+ *	 Add a sent command to the tail of the pipeline command queue.
+ *
+ * If nothing is in progress, the new command becomes the current one at once.
+ */
+static void
+pqAppendCmdQueueEntry(PGconn *conn, PGcmdQueueEntry *entry)
+{
+	if (conn->cmd_queue_tail == NULL)
+		conn->cmd_queue_head = entry;
+	else
+		conn->cmd_queue_tail->next = entry;
+	conn->cmd_queue_tail = entry;
+
+	if (conn->asyncStatus == PGASYNC_IDLE)
+		pqPipelineProcessQueue(conn);
+}
+
+/*
+ * pqCommandQueueAdvance
+ *	 Remove the finished command from the head of the pipeline queue.
+ */
+static void
+pqCommandQueueAdvance(PGconn *conn)
+{
+	PGcmdQueueEntry *prev = conn->cmd_queue_head;
+
+	if (prev == NULL)
+		return;
+
+	conn->cmd_queue_head = prev->next;
+	if (conn->cmd_queue_head == NULL)
+		conn->cmd_queue_tail = NULL;
+	if (prev->query)
+		free(prev->query);
+	free(prev);
+}
+
+/*
+ * pqPipelineProcessQueue
+ *	 Make the command at the head of the pipeline queue the current one.
+ *
+ * Called when the connection is idle, or between two pipelined commands.
+ * If the pipeline has been aborted by an error, commands before the next
+ * sync point will never get a response from the server, so we produce a
+ * PGRES_PIPELINE_ABORTED result for each of them here.
+ */
+static void
+pqPipelineProcessQueue(PGconn *conn)
+{
+	PGcmdQueueEntry *head = conn->cmd_queue_head;
+
+	if (conn->asyncStatus != PGASYNC_IDLE &&
+		conn->asyncStatus != PGASYNC_PIPELINE_IDLE)
+		return;
+
+	if (head == NULL)
+	{
+		conn->asyncStatus = PGASYNC_IDLE;
+		return;
+	}
+
+	/* initialize async result-accumulation state for the new command */
+	pqClearAsyncResult(conn);
+	conn->singleRowMode = false;
+	conn->rowBatchMode = false;
+
+	conn->queryclass = head->queryclass;
+	if (conn->last_query)
+		free(conn->last_query);
+	conn->last_query = head->query;
+	head->query = NULL;
+
+	if (conn->pipelineStatus == PQ_PIPELINE_ABORTED &&
+		head->queryclass != PGQUERY_SYNC)
+	{
+		resetPQExpBuffer(&conn->errorMessage);
+		conn->result = PQmakeEmptyPGresult(conn, PGRES_PIPELINE_ABORTED);
+		if (!conn->result)
+			printfPQExpBuffer(&conn->errorMessage,
+							  libpq_gettext("out of memory\n"));
+		conn->asyncStatus = PGASYNC_READY;
+	}
+	else
+		conn->asyncStatus = PGASYNC_BUSY;
+}
+
+/*
+ * pqPipelineFlush
+ *	 In pipeline mode, flush only once enough output has accumulated;
+ *	 otherwise push the data out at once, as usual.
+ */
+static int
+pqPipelineFlush(PGconn *conn)
+{
+	if (conn->pipelineStatus == PQ_PIPELINE_OFF ||
+		conn->outCount >= OUTBUFFER_THRESHOLD)
+		return pqFlush(conn);
+	return 0;
+}
+
 /*
  * PQnotifies
  *	  returns a PGnotify* structure of the latest async notification
@@ -2549,7 +3062,7 @@ PQfn(PGconn *conn,
 	resetPQExpBuffer(&conn->errorMessage);
 
 	if (conn->sock == PGINVALID_SOCKET || conn->asyncStatus != PGASYNC_IDLE ||
-		conn->result != NULL)
+		conn->pipelineStatus != PQ_PIPELINE_OFF || conn->result != NULL)
 	{
 		printfPQExpBuffer(&conn->errorMessage,
 						  libpq_gettext("connection in wrong state\n"));
@@ -47,6 +47,9 @@ static void handleSyncLoss(PGconn *conn, char id, int msgLength);
 static int	getRowDescriptions(PGconn *conn, int msgLength);
 static int	getParamDescriptions(PGconn *conn);
 static int	getAnotherTuple(PGconn *conn, int msgLength);
+static int getRowValues(PGconn *conn, int msgLength, PGdataValue *rowbuf,
+			 const char **errmsgp);
+static void setRowError(PGconn *conn, const char *errmsg);
 static int	getParameterStatus(PGconn *conn);
 static int	getNotify(PGconn *conn);
 static int	getCopyStart(PGconn *conn, ExecStatusType copytype);
@@ -214,11 +217,25 @@ pqParseInput3(PGconn *conn)
 					if (pqGetErrorNotice3(conn, true))
 						return;
 					conn->asyncStatus = PGASYNC_READY;
+					/* server skips the rest of the pipeline up to Sync */
+					if (conn->pipelineStatus != PQ_PIPELINE_OFF)
+						conn->pipelineStatus = PQ_PIPELINE_ABORTED;
 					break;
 				case 'Z':		/* backend is ready for new query */
 					if (getReadyForQuery(conn))
 						return;
-					conn->asyncStatus = PGASYNC_IDLE;
+					if (conn->pipelineStatus != PQ_PIPELINE_OFF)
+					{
+						/* end of a pipeline segment: report the sync point */
+						conn->result = PQmakeEmptyPGresult(conn,
+													   PGRES_PIPELINE_SYNC);
+						if (!conn->result)
+							return;
+						conn->pipelineStatus = PQ_PIPELINE_ON;
+						conn->asyncStatus = PGASYNC_READY;
+					}
+					else
+						conn->asyncStatus = PGASYNC_IDLE;
 					break;
 				case 'I':		/* empty query */
 					if (conn->result == NULL)
@@ -319,6 +336,9 @@ pqParseInput3(PGconn *conn)
 					if (conn->result != NULL &&
 						conn->result->resultStatus == PGRES_TUPLES_OK)
 					{
+						/* In row-batch mode, leave it for pqGetRowBatch3 */
+						if (conn->rowBatchMode)
+							return;
 						/* Read another tuple of a normal query response */
 						if (getAnotherTuple(conn, msgLength))
 							return;
@@ -679,23 +699,6 @@ getAnotherTuple(PGconn *conn, int msgLength)
 	int			nfields = result->numAttributes;
 	const char *errmsg;
 	PGdataValue *rowbuf;
-	int			tupnfields;		/* # fields from tuple */
-	int			vlen;			/* length of the current field value */
-	int			i;
-
-	/* Get the field count and make sure it's what we expect */
-	if (pqGetInt(&tupnfields, 2, conn))
-	{
-		/* We should not run out of data here, so complain */
-		errmsg = libpq_gettext("insufficient data in \"D\" message");
-		goto advance_and_error;
-	}
-
-	if (tupnfields != nfields)
-	{
-		errmsg = libpq_gettext("unexpected field count in \"D\" message");
-		goto advance_and_error;
-	}
 
 	/* Resize row buffer if needed */
 	rowbuf = conn->rowBuf;
@@ -713,14 +716,72 @@ getAnotherTuple(PGconn *conn, int msgLength)
 	}
 
 	/* Scan the fields */
+	if (getRowValues(conn, msgLength, rowbuf, &errmsg))
+		goto advance_and_error;
+
+	/* Advance inStart to show that the "D" message has been processed. */
+	conn->inStart = conn->inCursor;
+
+	/* Process the collected row */
+	errmsg = NULL;
+	if (pqRowProcessor(conn, &errmsg))
+		return 0;				/* normal, successful exit */
+
+	goto set_error_result;		/* pqRowProcessor failed, report it */
+
+advance_and_error:
+	/* Discard the failed message by pretending we read it */
+	conn->inStart += 5 + msgLength;
+
+set_error_result:
+	setRowError(conn, errmsg);
+
+	/*
+	 * Return zero to allow input parsing to continue.  Subsequent "D"
+	 * messages will be ignored until we get to end of data, since an error
+	 * result is already set up.
+	 */
+	return 0;
+}
+
+/*
+ * getRowValues: scan the fields of a 'D' message into rowbuf, which must
+ * have room for the result's number of fields.
+ * conn->inCursor must point just past the message length word; on exit it
+ * points past the message, but conn->inStart has not been moved.
+ * Returns 0 if OK, EOF with *errmsgp set if the message is malformed.
+ */
+static int
+getRowValues(PGconn *conn, int msgLength, PGdataValue *rowbuf,
+			 const char **errmsgp)
+{
+	int			nfields = conn->result->numAttributes;
+	int			tupnfields;		/* # fields from tuple */
+	int			vlen;			/* length of the current field value */
+	int			i;
+
+	/* Get the field count and make sure it's what we expect */
+	if (pqGetInt(&tupnfields, 2, conn))
+	{
+		/* We should not run out of data here, so complain */
+		*errmsgp = libpq_gettext("insufficient data in \"D\" message");
+		return EOF;
+	}
+
+	if (tupnfields != nfields)
+	{
+		*errmsgp = libpq_gettext("unexpected field count in \"D\" message");
+		return EOF;
+	}
+
 	for (i = 0; i < nfields; i++)
 	{
 		/* get the value length */
 		if (pqGetInt(&vlen, 4, conn))
 		{
 			/* We should not run out of data here, so complain */
-			errmsg = libpq_gettext("insufficient data in \"D\" message");
-			goto advance_and_error;
+			*errmsgp = libpq_gettext("insufficient data in \"D\" message");
+			return EOF;
 		}
 		rowbuf[i].len = vlen;
 
@@ -737,8 +798,8 @@ getAnotherTuple(PGconn *conn, int msgLength)
 			if (pqSkipnchar(vlen, conn))
 			{
 				/* We should not run out of data here, so complain */
-				errmsg = libpq_gettext("insufficient data in \"D\" message");
-				goto advance_and_error;
+				*errmsgp = libpq_gettext("insufficient data in \"D\" message");
+				return EOF;
 			}
 		}
 	}
@@ -746,29 +807,99 @@ getAnotherTuple(PGconn *conn, int msgLength)
 	/* Sanity check that we absorbed all the data */
 	if (conn->inCursor != conn->inStart + 5 + msgLength)
 	{
-		errmsg = libpq_gettext("extraneous data in \"D\" message");
-		goto advance_and_error;
+		*errmsgp = libpq_gettext("extraneous data in \"D\" message");
+		return EOF;
 	}
 
-	/* Advance inStart to show that the "D" message has been processed. */
-	conn->inStart = conn->inCursor;
+	return 0;
+}
 
-	/* Process the collected row */
-	errmsg = NULL;
-	if (pqRowProcessor(conn, &errmsg))
-		return 0;				/* normal, successful exit */
+/*
+ * pqGetRowBatch3: collect up to maxrows complete 'D' messages at the front
+ * of the input buffer into conn->batchBuf, without copying the data.
+ * maxrows <= 0 means no limit.  The values point into conn->inBuffer, so
+ * they stay valid only until more data is read.
+ *
+ * Returns the number of rows collected, or -1 if an error result has been
+ * set up, in which case the remaining rows will be discarded by the normal
+ * input parser.
+ */
+int
+pqGetRowBatch3(PGconn *conn, int maxrows)
+{
+	PGresult   *result = conn->result;
+	int			nfields;
+	int			nrows = 0;
+	char		id;
+	int			msgLength;
+	const char *errmsg;
 
-	goto set_error_result;		/* pqRowProcessor failed, report it */
+	if (result == NULL || result->resultStatus != PGRES_TUPLES_OK)
+		return 0;
+	nfields = result->numAttributes;
 
-advance_and_error:
-	/* Discard the failed message by pretending we read it */
-	conn->inStart += 5 + msgLength;
+	while (maxrows <= 0 || nrows < maxrows)
+	{
+		PGdataValue *rowbuf;
 
-set_error_result:
+		/*
+		 * Stop at anything but a complete 'D' message; pqParseInput3 will
+		 * deal with it, including enlarging the buffer for an incomplete one.
+		 */
+		conn->inCursor = conn->inStart;
+		if (pqGetc(&id, conn) || id != 'D')
+			break;
+		if (pqGetInt(&msgLength, 4, conn) || msgLength < 4)
+			break;
+		msgLength -= 4;
+		if (conn->inEnd - conn->inCursor < msgLength)
+			break;
 
+		/* Resize batch buffer if needed */
+		if ((nrows + 1) * nfields > conn->batchBufLen)
+		{
+			int			newlen = Max(conn->batchBufLen * 2, 256);
+
+			while ((nrows + 1) * nfields > newlen)
+				newlen *= 2;
+			rowbuf = (PGdataValue *) realloc(conn->batchBuf,
+											 newlen * sizeof(PGdataValue));
+			if (!rowbuf)
+			{
+				setRowError(conn, NULL);
+				return -1;
+			}
+			conn->batchBuf = rowbuf;
+			conn->batchBufLen = newlen;
+		}
+
+		rowbuf = conn->batchBuf + nrows * nfields;
+		if (getRowValues(conn, msgLength, rowbuf, &errmsg))
+		{
+			/* Discard the failed message, and the rows gathered so far */
+			conn->inStart += 5 + msgLength;
+			setRowError(conn, errmsg);
+			return -1;
+		}
+
+		/* Advance inStart to show that the "D" message has been processed. */
+		conn->inStart = conn->inCursor;
+		nrows++;
+	}
+
+	return nrows;
+}
+
+/*
+ * setRowError: replace the partially constructed result with an error
+ * result, after failing to process a 'D' message.  A NULL errmsg means
+ * "out of memory".
+ */
+static void
+setRowError(PGconn *conn, const char *errmsg)
+{
 	/*
-	 * Replace partially constructed result with an error result. First
-	 * discard the old result to try to win back some memory.
+	 * Discard the old result first, to try to win back some memory.
 	 */
 	pqClearAsyncResult(conn);
 
@@ -783,13 +914,6 @@ set_error_result:
 
 	printfPQExpBuffer(&conn->errorMessage, "%s\n", errmsg);
 	pqSaveErrorResult(conn);
-
-	/*
-	 * Return zero to allow input parsing to continue.  Subsequent "D"
-	 * messages will be ignored until we get to end of data, since an error
-	 * result is already set up.
-	 */
-	return 0;
 }
 
 
@@ -219,7 +219,9 @@ typedef enum
 	PGASYNC_READY,				/* result ready for PQgetResult */
 	PGASYNC_COPY_IN,			/* Copy In data transfer in progress */
 	PGASYNC_COPY_OUT,			/* Copy Out data transfer in progress */
-	PGASYNC_COPY_BOTH			/* Copy In/Out data transfer in progress */
+	PGASYNC_COPY_BOTH,			/* Copy In/Out data transfer in progress */
+	PGASYNC_PIPELINE_IDLE		/* pipeline mode: between commands, see
+								 * pqPipelineProcessQueue */
 } PGAsyncStatusType;
 
 /* PGQueryClass tracks which query protocol we are now executing */
@@ -228,9 +230,28 @@ typedef enum
 	PGQUERY_SIMPLE,				/* simple Query protocol (PQexec) */
 	PGQUERY_EXTENDED,			/* full Extended protocol (PQexecParams) */
 	PGQUERY_PREPARE,			/* Parse only (PQprepare) */
-	PGQUERY_DESCRIBE			/* Describe Statement or Portal */
+	PGQUERY_DESCRIBE,			/* Describe Statement or Portal */
+	PGQUERY_SYNC				/* Sync (at end of a pipeline) */
 } PGQueryClass;
 
+/*
+ * In pipeline mode, each command sent to the server but not yet completely
+ * processed has an entry in a FIFO queue hanging off the PGconn.  The head
+ * of the queue is the command whose results are currently being read.
+ */
+typedef struct PGcmdQueueEntry
+{
+	PGQueryClass queryclass;	/* query type of this command */
+	char	   *query;			/* SQL command, or NULL if none/unknown */
+	struct PGcmdQueueEntry *next;		/* list link */
+} PGcmdQueueEntry;
+
+/*
+ * In pipeline mode, the output buffer is flushed only once it holds at
+ * least this many bytes, so that many small commands go out together.
+ */
+#define OUTBUFFER_THRESHOLD	65536
+
 /* PGSetenvStatusType defines the state of the PQSetenv state machine */
 /* (this is used only for 2.0-protocol connections) */
 typedef enum
@@ -280,17 +301,6 @@ typedef struct pgLobjfuncs
 	Oid			fn_lo_write;	/* OID of backend function LOwrite		*/
 } PGlobjfuncs;
 
-/* PGdataValue represents a data field value being passed to a row processor.
- * It could be either text or binary data; text data is not zero-terminated.
- * A SQL NULL is represented by len < 0; then value is still valid but there
- * are no data bytes there.
- */
-typedef struct pgDataValue
-{
-	int			len;			/* data length in bytes, or <0 if NULL */
-	const char *value;			/* data value, without zero-termination */
-} PGdataValue;
-
 /*
  * PGconn stores all the state data associated with a single connection
  * to a backend.
@@ -357,6 +367,10 @@ struct pg_conn
 	bool		nonblocking;	/* whether this connection is using nonblock
 								 * sending semantics */
 	bool		singleRowMode;	/* return current query result row-by-row? */
+	bool		rowBatchMode;	/* leave data rows for PQgetRowBatch? */
+	PGpipelineStatus pipelineStatus;	/* status of pipeline mode */
+	PGcmdQueueEntry *cmd_queue_head;	/* oldest unfinished command */
+	PGcmdQueueEntry *cmd_queue_tail;	/* newest unfinished command */
 	char		copy_is_binary; /* 1 = copy binary, 0 = copy text */
 	int			copy_already_done;		/* # bytes already returned in COPY
 										 * OUT */
@@ -416,6 +430,8 @@ struct pg_conn
 	/* Row processor interface workspace */
 	PGdataValue *rowBuf;		/* array for passing values to rowProcessor */
 	int			rowBufLen;		/* number of entries allocated in rowBuf */
+	PGdataValue *batchBuf;		/* array of values returned by PQgetRowBatch */
+	int			batchBufLen;	/* number of entries allocated in batchBuf */
 
 	/* Status for asynchronous result construction */
 	PGresult   *result;			/* result being constructed */
@@ -575,6 +591,7 @@ extern char *pqBuildStartupPacket3(PGconn *conn, int *packetlen,
 					  const PQEnvironmentOption *options);
 extern void pqParseInput3(PGconn *conn);
 extern int	pqGetErrorNotice3(PGconn *conn, bool isError);
+extern int	pqGetRowBatch3(PGconn *conn, int maxrows);
 extern int	pqGetCopyData3(PGconn *conn, char **buffer, int async);
 extern int	pqGetline3(PGconn *conn, char *s, int maxlen);
 extern int	pqGetlineAsync3(PGconn *conn, char *buffer, int bufsize);
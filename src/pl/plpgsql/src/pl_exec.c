@@ -104,6 +104,36 @@ typedef struct SimpleEcontextStackEntry
 static EState *shared_simple_eval_estate = NULL;
 static SimpleEcontextStackEntry *simple_econtext_stack = NULL;
 
+/*
+ * A SELECT INTO executed inside a loop keeps its executor running from one
+ * iteration to the next, as long as its plan allows; see
+ * exec_stmt_execsql_rerun.  The function's execstate has a list of these
+ * entries, one per statement, each belonging to the innermost loop the
+ * statement was executed in.  They are got rid of when that loop is left.
+ */
+typedef struct
+{
+	DestReceiver pub;			/* publicly-known function pointers */
+	MemoryContext cxt;			/* context to copy the first row into */
+	HeapTuple	tuple;			/* the first row, or NULL */
+} PLpgSQL_into_receiver;
+
+typedef struct
+{
+	PLpgSQL_stmt_execsql *stmt; /* statement this is for */
+	int			loop_depth;		/* nesting level of the loop it belongs to */
+	ResourceOwner owner;		/* holds the executor's resources */
+	MemoryContext cxt;			/* holds the QueryDesc and executor state */
+	CachedPlan *cplan;			/* plan being executed, or NULL */
+	QueryDesc  *qdesc;			/* executor state, or NULL */
+	Oid			userid;			/* user the executor was started as */
+	SubTransactionId subxid;	/* subtransaction it was started in */
+	bool		rerunnable;		/* can qdesc be run again? */
+	bool		norerun;		/* statement must always go through SPI */
+	bool		failed;			/* error occurred while using the executor */
+	PLpgSQL_into_receiver receiver;		/* destination of the rows */
+} PLpgSQL_rerun_query;
+
 /************************************************************
  * Local function forward declarations
  ************************************************************/
@@ -158,6 +188,22 @@ static int exec_stmt_assert(PLpgSQL_execstate *estate,
 				 PLpgSQL_stmt_assert *stmt);
 static int exec_stmt_execsql(PLpgSQL_execstate *estate,
 				  PLpgSQL_stmt_execsql *stmt);
+static bool exec_stmt_execsql_rerun(PLpgSQL_execstate *estate,
+						PLpgSQL_stmt_execsql *stmt,
+						ParamListInfo paramLI, long tcount,
+						uint32 *processed, HeapTuple *tuple,
+						TupleDesc *tupdesc);
+static PLpgSQL_rerun_query *exec_get_rerun_query(PLpgSQL_execstate *estate,
+					 PLpgSQL_stmt_execsql *stmt);
+static void exec_stop_rerun_query(PLpgSQL_rerun_query *rq);
+static void exec_stop_rerun_queries(PLpgSQL_execstate *estate);
+static void exec_end_rerun_queries(PLpgSQL_execstate *estate, int loop_depth,
+					   bool release);
+static void plpgsql_into_receive(TupleTableSlot *slot, DestReceiver *self);
+static void plpgsql_into_startup(DestReceiver *self, int operation,
+					 TupleDesc typeinfo);
+static void plpgsql_into_shutdown(DestReceiver *self);
+static void plpgsql_sql_error_callback(void *arg);
 static int exec_stmt_dynexecute(PLpgSQL_execstate *estate,
 					 PLpgSQL_stmt_dynexecute *stmt);
 static int exec_stmt_dynfors(PLpgSQL_execstate *estate,
@@ -224,6 +270,9 @@ static void exec_move_row(PLpgSQL_execstate *estate,
 static HeapTuple make_tuple_from_row(PLpgSQL_execstate *estate,
 					PLpgSQL_row *row,
 					TupleDesc tupdesc);
+static void exec_rec_deform(PLpgSQL_execstate *estate, PLpgSQL_rec *rec);
+static void exec_rec_flatten(PLpgSQL_execstate *estate, PLpgSQL_rec *rec);
+static void exec_rec_free_fields(PLpgSQL_rec *rec);
 static HeapTuple get_tuple_from_datum(Datum value);
 static TupleDesc get_tupdesc_from_datum(Datum value);
 static void exec_move_row_from_datum(PLpgSQL_execstate *estate,
@@ -1031,6 +1080,10 @@ copy_plpgsql_datum(PLpgSQL_datum *datum)
 				new->tupdesc = NULL;
 				new->freetup = false;
 				new->freetupdesc = false;
+				new->fvalues = NULL;
+				new->fnulls = NULL;
+				new->ffree = NULL;
+				new->modified = false;
 
 				result = (PLpgSQL_datum *) new;
 			}
@@ -1157,6 +1210,7 @@ exec_stmt_block(PLpgSQL_execstate *estate, PLpgSQL_stmt_block *block)
 				{
 					PLpgSQL_rec *rec = (PLpgSQL_rec *) (estate->datums[n]);
 
+					exec_rec_free_fields(rec);
 					if (rec->freetup)
 					{
 						heap_freetuple(rec->tup);
@@ -1191,6 +1245,8 @@ exec_stmt_block(PLpgSQL_execstate *estate, PLpgSQL_stmt_block *block)
 		ResourceOwner oldowner = CurrentResourceOwner;
 		ExprContext *old_eval_econtext = estate->eval_econtext;
 		ErrorData  *save_cur_error = estate->cur_error;
+		int			save_loop_depth = estate->loop_depth;
+		ResourceOwner save_loop_owner = estate->loop_owner;
 
 		estate->err_text = gettext_noop("during statement block entry");
 
@@ -1271,6 +1327,14 @@ exec_stmt_block(PLpgSQL_execstate *estate, PLpgSQL_stmt_block *block)
 			/* Revert to outer eval_econtext */
 			estate->eval_econtext = old_eval_econtext;
 
+			/*
+			 * Forget the executors kept for loops inside the block; their
+			 * resource owners went away with the subtransaction's.
+			 */
+			exec_end_rerun_queries(estate, save_loop_depth, false);
+			estate->loop_depth = save_loop_depth;
+			estate->loop_owner = save_loop_owner;
+
 			/*
 			 * If AtEOSubXact_SPI() popped any SPI context of the subxact, it
 			 * will have left us in a disconnected state.  We need this hack
@@ -1431,6 +1495,9 @@ static int
 exec_stmt(PLpgSQL_execstate *estate, PLpgSQL_stmt *stmt)
 {
 	PLpgSQL_stmt *save_estmt;
+	int			save_loop_depth = estate->loop_depth;
+	ResourceOwner save_loop_owner = estate->loop_owner;
+	bool		is_loop;
 	int			rc = -1;
 
 	save_estmt = estate->err_stmt;
@@ -1442,6 +1509,28 @@ exec_stmt(PLpgSQL_execstate *estate, PLpgSQL_stmt *stmt)
 
 	CHECK_FOR_INTERRUPTS();
 
+	/*
+	 * Keep track of the loops we are in, for exec_stmt_execsql_rerun.
+	 */
+	switch ((enum PLpgSQL_stmt_types) stmt->cmd_type)
+	{
+		case PLPGSQL_STMT_LOOP:
+		case PLPGSQL_STMT_WHILE:
+		case PLPGSQL_STMT_FORI:
+		case PLPGSQL_STMT_FORS:
+		case PLPGSQL_STMT_FORC:
+		case PLPGSQL_STMT_FOREACH_A:
+		case PLPGSQL_STMT_DYNFORS:
+			is_loop = true;
+			estate->loop_depth++;
+			estate->loop_owner = CurrentResourceOwner;
+			break;
+
+		default:
+			is_loop = false;
+			break;
+	}
+
 	switch ((enum PLpgSQL_stmt_types) stmt->cmd_type)
 	{
 		case PLPGSQL_STMT_BLOCK:
@@ -1545,6 +1634,14 @@ exec_stmt(PLpgSQL_execstate *estate, PLpgSQL_stmt *stmt)
 			elog(ERROR, "unrecognized cmdtype: %d", stmt->cmd_type);
 	}
 
+	/* Shut down any executors kept for statements inside the loop */
+	if (is_loop)
+	{
+		exec_end_rerun_queries(estate, save_loop_depth, true);
+		estate->loop_depth = save_loop_depth;
+		estate->loop_owner = save_loop_owner;
+	}
+
 	/* Let the plugin know that we have finished executing this statement */
 	if (*plugin_ptr && (*plugin_ptr)->stmt_end)
 		((*plugin_ptr)->stmt_end) (estate, stmt);
@@ -2541,6 +2638,7 @@ exec_stmt_return(PLpgSQL_execstate *estate, PLpgSQL_stmt_return *stmt)
 				{
 					PLpgSQL_rec *rec = (PLpgSQL_rec *) retvar;
 
+					exec_rec_flatten(estate, rec);
 					if (HeapTupleIsValid(rec->tup))
 					{
 						estate->retval = PointerGetDatum(rec->tup);
@@ -2702,6 +2800,7 @@ exec_stmt_return_next(PLpgSQL_execstate *estate,
 								  rec->refname),
 						errdetail("The tuple structure of a not-yet-assigned"
 								  " record is indeterminate.")));
+					exec_rec_flatten(estate, rec);
 					tupmap = convert_tuples_by_position(rec->tupdesc,
 														tupdesc,
 														gettext_noop("wrong record type supplied in RETURN NEXT"));
@@ -3268,6 +3367,7 @@ plpgsql_estate_setup(PLpgSQL_execstate *estate,
 	estate->ndatums = func->ndatums;
 	estate->datums = palloc(sizeof(PLpgSQL_datum *) * estate->ndatums);
 	/* caller is expected to fill the datums array */
+	estate->datum_context = CurrentMemoryContext;
 
 	/* initialize ParamListInfo with one entry per datum, all invalid */
 	estate->paramLI = (ParamListInfo)
@@ -3285,6 +3385,10 @@ plpgsql_estate_setup(PLpgSQL_execstate *estate,
 	else
 		estate->simple_eval_estate = shared_simple_eval_estate;
 
+	estate->rerun_queries = NIL;
+	estate->loop_depth = 0;
+	estate->loop_owner = NULL;
+
 	estate->eval_tuptable = NULL;
 	estate->eval_processed = 0;
 	estate->eval_lastoid = InvalidOid;
@@ -3409,6 +3513,10 @@ exec_stmt_execsql(PLpgSQL_execstate *estate,
 	long		tcount;
 	int			rc;
 	PLpgSQL_expr *expr = stmt->sqlstmt;
+	SPITupleTable *tuptab = NULL;
+	uint32		n;
+	HeapTuple	tuple = NULL;
+	TupleDesc	tupdesc = NULL;
 
 	/*
 	 * On the first call for this statement generate the plan, and detect
@@ -3420,6 +3528,7 @@ exec_stmt_execsql(PLpgSQL_execstate *estate,
 
 		exec_prepare_plan(estate, expr, 0);
 		stmt->mod_stmt = false;
+		stmt->utility_stmt = false;
 		foreach(l, SPI_plan_get_plan_sources(expr->plan))
 		{
 			CachedPlanSource *plansource = (CachedPlanSource *) lfirst(l);
@@ -3437,6 +3546,8 @@ exec_stmt_execsql(PLpgSQL_execstate *estate,
 						q->commandType == CMD_DELETE)
 						stmt->mod_stmt = true;
 				}
+				if (q->commandType == CMD_UTILITY)
+					stmt->utility_stmt = true;
 			}
 		}
 	}
@@ -3468,83 +3579,121 @@ exec_stmt_execsql(PLpgSQL_execstate *estate,
 		tcount = 0;
 
 	/*
-	 * Execute the plan
+	 * Inside a loop, a SELECT INTO may be able to go through an executor
+	 * kept from the previous iteration.
 	 */
-	rc = SPI_execute_plan_with_paramlist(expr->plan, paramLI,
-										 estate->readonly_func, tcount);
+	if (exec_stmt_execsql_rerun(estate, stmt, paramLI, tcount,
+								&n, &tuple, &tupdesc))
+	{
+		exec_set_found(estate, (n != 0));
 
-	/*
-	 * Check for error, and set FOUND if appropriate (for historical reasons
-	 * we set FOUND only for certain query types).  Also Assert that we
-	 * identified the statement type the same as SPI did.
-	 */
-	switch (rc)
+		estate->eval_processed = n;
+		estate->eval_lastoid = InvalidOid;
+	}
+	else
 	{
-		case SPI_OK_SELECT:
-			Assert(!stmt->mod_stmt);
-			exec_set_found(estate, (SPI_processed != 0));
-			break;
+		/*
+		 * A kept executor holds its relations open, which would make
+		 * commands like TRUNCATE or ALTER TABLE fail on them.
+		 */
+		if (stmt->utility_stmt)
+			exec_stop_rerun_queries(estate);
 
-		case SPI_OK_INSERT:
-		case SPI_OK_UPDATE:
-		case SPI_OK_DELETE:
-		case SPI_OK_INSERT_RETURNING:
-		case SPI_OK_UPDATE_RETURNING:
-		case SPI_OK_DELETE_RETURNING:
-			Assert(stmt->mod_stmt);
-			exec_set_found(estate, (SPI_processed != 0));
-			break;
+		/*
+		 * Execute the plan
+		 */
+		rc = SPI_execute_plan_with_paramlist(expr->plan, paramLI,
+											 estate->readonly_func, tcount);
 
-		case SPI_OK_SELINTO:
-		case SPI_OK_UTILITY:
-			Assert(!stmt->mod_stmt);
-			break;
+		/*
+		 * Check for error, and set FOUND if appropriate (for historical
+		 * reasons we set FOUND only for certain query types).  Also Assert
+		 * that we identified the statement type the same as SPI did.
+		 */
+		switch (rc)
+		{
+			case SPI_OK_SELECT:
+				Assert(!stmt->mod_stmt);
+				exec_set_found(estate, (SPI_processed != 0));
+				break;
 
-		case SPI_OK_REWRITTEN:
-			Assert(!stmt->mod_stmt);
+			case SPI_OK_INSERT:
+			case SPI_OK_UPDATE:
+			case SPI_OK_DELETE:
+			case SPI_OK_INSERT_RETURNING:
+			case SPI_OK_UPDATE_RETURNING:
+			case SPI_OK_DELETE_RETURNING:
+				Assert(stmt->mod_stmt);
+				exec_set_found(estate, (SPI_processed != 0));
+				break;
 
-			/*
-			 * The command was rewritten into another kind of command. It's
-			 * not clear what FOUND would mean in that case (and SPI doesn't
-			 * return the row count either), so just set it to false.
-			 */
-			exec_set_found(estate, false);
-			break;
+			case SPI_OK_SELINTO:
+			case SPI_OK_UTILITY:
+				Assert(!stmt->mod_stmt);
+				break;
 
-			/* Some SPI errors deserve specific error messages */
-		case SPI_ERROR_COPY:
-			ereport(ERROR,
-					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-					 errmsg("cannot COPY to/from client in PL/pgSQL")));
-		case SPI_ERROR_TRANSACTION:
-			ereport(ERROR,
-					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-					 errmsg("cannot begin/end transactions in PL/pgSQL"),
-			errhint("Use a BEGIN block with an EXCEPTION clause instead.")));
+			case SPI_OK_REWRITTEN:
+				Assert(!stmt->mod_stmt);
 
-		default:
-			elog(ERROR, "SPI_execute_plan_with_paramlist failed executing query \"%s\": %s",
-				 expr->query, SPI_result_code_string(rc));
-	}
+				/*
+				 * The command was rewritten into another kind of command.
+				 * It's not clear what FOUND would mean in that case (and SPI
+				 * doesn't return the row count either), so just set it to
+				 * false.
+				 */
+				exec_set_found(estate, false);
+				break;
 
-	/* All variants should save result info for GET DIAGNOSTICS */
-	estate->eval_processed = SPI_processed;
-	estate->eval_lastoid = SPI_lastoid;
+				/* Some SPI errors deserve specific error messages */
+			case SPI_ERROR_COPY:
+				ereport(ERROR,
+						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						 errmsg("cannot COPY to/from client in PL/pgSQL")));
+			case SPI_ERROR_TRANSACTION:
+				ereport(ERROR,
+						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						 errmsg("cannot begin/end transactions in PL/pgSQL"),
+						 errhint("Use a BEGIN block with an EXCEPTION clause instead.")));
+
+			default:
+				elog(ERROR, "SPI_execute_plan_with_paramlist failed executing query \"%s\": %s",
+					 expr->query, SPI_result_code_string(rc));
+		}
+
+		/* All variants should save result info for GET DIAGNOSTICS */
+		estate->eval_processed = SPI_processed;
+		estate->eval_lastoid = SPI_lastoid;
+
+		tuptab = SPI_tuptable;
+		n = SPI_processed;
+
+		if (stmt->into)
+		{
+			/* If the statement did not return a tuple table, complain */
+			if (tuptab == NULL)
+				ereport(ERROR,
+						(errcode(ERRCODE_SYNTAX_ERROR),
+						 errmsg("INTO used with a command that cannot return data")));
+			tuple = (n > 0) ? tuptab->vals[0] : NULL;
+			tupdesc = tuptab->tupdesc;
+		}
+		else
+		{
+			/* If the statement returned a tuple table, complain */
+			if (tuptab != NULL)
+				ereport(ERROR,
+						(errcode(ERRCODE_SYNTAX_ERROR),
+						 errmsg("query has no destination for result data"),
+						 (rc == SPI_OK_SELECT) ? errhint("If you want to discard the results of a SELECT, use PERFORM instead.") : 0));
+		}
+	}
 
 	/* Process INTO if present */
 	if (stmt->into)
 	{
-		SPITupleTable *tuptab = SPI_tuptable;
-		uint32		n = SPI_processed;
 		PLpgSQL_rec *rec = NULL;
 		PLpgSQL_row *row = NULL;
 
-		/* If the statement did not return a tuple table, complain */
-		if (tuptab == NULL)
-			ereport(ERROR,
-					(errcode(ERRCODE_SYNTAX_ERROR),
-				errmsg("INTO used with a command that cannot return data")));
-
 		/* Determine if we assign to a record or a row */
 		if (stmt->rec != NULL)
 			rec = (PLpgSQL_rec *) (estate->datums[stmt->rec->dno]);
@@ -3575,7 +3724,7 @@ exec_stmt_execsql(PLpgSQL_execstate *estate,
 						 errdetail ? errdetail_internal("parameters: %s", errdetail) : 0));
 			}
 			/* set the target to NULL(s) */
-			exec_move_row(estate, rec, row, NULL, tuptab->tupdesc);
+			exec_move_row(estate, rec, row, NULL, tupdesc);
 		}
 		else
 		{
@@ -3594,24 +3743,402 @@ exec_stmt_execsql(PLpgSQL_execstate *estate,
 						 errdetail ? errdetail_internal("parameters: %s", errdetail) : 0));
 			}
 			/* Put the first result row into the target */
-			exec_move_row(estate, rec, row, tuptab->vals[0], tuptab->tupdesc);
+			exec_move_row(estate, rec, row, tuple, tupdesc);
 		}
 
 		/* Clean up */
 		exec_eval_cleanup(estate);
-		SPI_freetuptable(SPI_tuptable);
+		SPI_freetuptable(tuptab);
 	}
-	else
+
+	return PLPGSQL_RC_OK;
+}
+
+
+/* ----------
+ * exec_stmt_execsql_rerun		Run a SELECT INTO inside a loop, keeping
+ *								its executor for the next iteration
+ *
+ * Going through SPI costs a complete executor startup and shutdown for
+ * every execution of the statement, which dominates the runtime of a
+ * simple single-row lookup done once per loop iteration.  Here we instead
+ * keep the QueryDesc of the statement's generic plan open until the loop
+ * is left, and merely rescan it with new parameter values and a new
+ * snapshot each time around (see ExecutorRerun).  Plans that can't be
+ * rerun that way, and custom plans, are started and run here as well but
+ * not reused.
+ *
+ * Returns false if the statement must be run through SPI instead;
+ * otherwise the number of rows processed, the first row (in the
+ * eval_econtext's per-tuple memory) and its descriptor are returned.
+ * ----------
+ */
+static bool
+exec_stmt_execsql_rerun(PLpgSQL_execstate *estate,
+						PLpgSQL_stmt_execsql *stmt,
+						ParamListInfo paramLI, long tcount,
+						uint32 *processed, HeapTuple *tuple,
+						TupleDesc *tupdesc)
+{
+	PLpgSQL_expr *expr = stmt->sqlstmt;
+	List	   *plansources;
+	CachedPlanSource *plansource;
+	PLpgSQL_rerun_query *rq;
+	ErrorContextCallback sqlerrcontext;
+	ResourceOwner oldowner;
+	bool		result = true;
+
+	/*
+	 * Only SELECT INTO inside loops is worth the trouble.  Executor hooks
+	 * expect to see every execution, so don't bypass them either.
+	 */
+	if (estate->loop_depth == 0 || !stmt->into || stmt->mod_stmt)
+		return false;
+	if (ExecutorStart_hook || ExecutorRun_hook ||
+		ExecutorFinish_hook || ExecutorEnd_hook)
+		return false;
+	if (estate->readonly_func && !ActiveSnapshotSet())
+		return false;
+
+	plansources = SPI_plan_get_plan_sources(expr->plan);
+	if (list_length(plansources) != 1)
+		return false;
+	plansource = (CachedPlanSource *) linitial(plansources);
+
+	rq = exec_get_rerun_query(estate, stmt);
+	if (rq->norerun)
 	{
-		/* If the statement returned a tuple table, complain */
-		if (SPI_tuptable != NULL)
-			ereport(ERROR,
-					(errcode(ERRCODE_SYNTAX_ERROR),
-					 errmsg("query has no destination for result data"),
-					 (rc == SPI_OK_SELECT) ? errhint("If you want to discard the results of a SELECT, use PERFORM instead.") : 0));
+		exec_stop_rerun_query(rq);
+		return false;
 	}
 
-	return PLPGSQL_RC_OK;
+	/*
+	 * The executor can be continued only by the user it was started by, and
+	 * within the subtransaction it was started in.
+	 */
+	if (rq->failed ||
+		(rq->qdesc != NULL &&
+		 (rq->userid != GetUserId() ||
+		  rq->subxid != GetCurrentSubTransactionId())))
+		exec_stop_rerun_query(rq);
+
+	/* Report errors the same way as SPI does */
+	sqlerrcontext.callback = plpgsql_sql_error_callback;
+	sqlerrcontext.arg = (void *) plansource->query_string;
+	sqlerrcontext.previous = error_context_stack;
+	error_context_stack = &sqlerrcontext;
+
+	oldowner = CurrentResourceOwner;
+
+	PG_TRY();
+	{
+		CachedPlan *cplan;
+		Snapshot	snapshot;
+
+		/*
+		 * Get a snapshot as SPI would: in the default non-read-only case a
+		 * new one, with the command counter advanced.
+		 */
+		if (!estate->readonly_func)
+		{
+			PushActiveSnapshot(GetTransactionSnapshot());
+			CommandCounterIncrement();
+			UpdateActiveSnapshotCommandId();
+		}
+		snapshot = GetActiveSnapshot();
+
+		CurrentResourceOwner = rq->owner;
+
+		cplan = GetCachedPlan(plansource, paramLI, true);
+
+		if (rq->qdesc != NULL && rq->rerunnable && cplan == rq->cplan)
+		{
+			/* Same plan as last time; we hold a refcount on it already */
+			ReleaseCachedPlan(cplan, true);
+			ExecutorRerun(rq->qdesc, snapshot);
+		}
+		else
+		{
+			PlannedStmt *pstmt = (PlannedStmt *) linitial(cplan->stmt_list);
+			MemoryContext oldcontext;
+
+			exec_stop_rerun_query(rq);
+
+			if (list_length(cplan->stmt_list) != 1 ||
+				!IsA(pstmt, PlannedStmt) ||
+				pstmt->commandType != CMD_SELECT ||
+				pstmt->utilityStmt != NULL ||
+				!pstmt->canSetTag)
+			{
+				/* Something SPI must deal with, so give up on it for good */
+				ReleaseCachedPlan(cplan, true);
+				rq->norerun = true;
+				result = false;
+			}
+			else
+			{
+				rq->cplan = cplan;
+				rq->rerunnable = (cplan == plansource->gplan &&
+								  pstmt->subplans == NIL &&
+								  pstmt->rowMarks == NIL &&
+								  !pstmt->hasModifyingCTE &&
+								  !pstmt->parallelModeNeeded &&
+								  ExecSupportsRerun(pstmt->planTree));
+				if (cplan == plansource->gplan && !rq->rerunnable)
+					rq->norerun = true;
+
+				oldcontext = MemoryContextSwitchTo(rq->cxt);
+				rq->qdesc = CreateQueryDesc(pstmt,
+											plansource->query_string,
+											snapshot, InvalidSnapshot,
+											(DestReceiver *) &rq->receiver,
+											paramLI, 0);
+				ExecutorStart(rq->qdesc, 0);
+				MemoryContextSwitchTo(oldcontext);
+
+				rq->userid = GetUserId();
+				rq->subxid = GetCurrentSubTransactionId();
+			}
+		}
+
+		if (result)
+		{
+			rq->receiver.cxt = estate->eval_econtext->ecxt_per_tuple_memory;
+			rq->receiver.tuple = NULL;
+
+			ExecutorRun(rq->qdesc, ForwardScanDirection, tcount);
+
+			*processed = rq->qdesc->estate->es_processed;
+			*tuple = rq->receiver.tuple;
+			*tupdesc = rq->qdesc->tupDesc;
+		}
+
+		CurrentResourceOwner = oldowner;
+
+		if (!estate->readonly_func)
+		{
+			PopActiveSnapshot();
+			CommandCounterIncrement();
+		}
+	}
+	PG_CATCH();
+	{
+		/* Leave the cleanup of the executor to exec_stop_rerun_query */
+		rq->failed = true;
+		CurrentResourceOwner = oldowner;
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	error_context_stack = sqlerrcontext.previous;
+
+	return result;
+}
+
+/*
+ * Find or make the rerun_queries entry for a statement
+ */
+static PLpgSQL_rerun_query *
+exec_get_rerun_query(PLpgSQL_execstate *estate, PLpgSQL_stmt_execsql *stmt)
+{
+	PLpgSQL_rerun_query *rq;
+	MemoryContext oldcontext;
+	ListCell   *lc;
+
+	foreach(lc, estate->rerun_queries)
+	{
+		rq = (PLpgSQL_rerun_query *) lfirst(lc);
+		if (rq->stmt == stmt)
+			return rq;
+	}
+
+	oldcontext = MemoryContextSwitchTo(estate->datum_context);
+
+	rq = (PLpgSQL_rerun_query *) palloc0(sizeof(PLpgSQL_rerun_query));
+	rq->stmt = stmt;
+	rq->loop_depth = estate->loop_depth;
+
+	/*
+	 * The executor's resources belong to the innermost loop's resource
+	 * owner, which outlives any subtransaction started inside the loop.
+	 */
+	rq->owner = ResourceOwnerCreate(estate->loop_owner, "PL/pgSQL query");
+	rq->cxt = AllocSetContextCreate(estate->datum_context,
+									"PL/pgSQL query",
+									ALLOCSET_SMALL_MINSIZE,
+									ALLOCSET_SMALL_INITSIZE,
+									ALLOCSET_DEFAULT_MAXSIZE);
+	rq->receiver.pub.receiveSlot = plpgsql_into_receive;
+	rq->receiver.pub.rStartup = plpgsql_into_startup;
+	rq->receiver.pub.rShutdown = plpgsql_into_shutdown;
+	rq->receiver.pub.rDestroy = plpgsql_into_shutdown;
+	rq->receiver.pub.mydest = DestNone;
+
+	estate->rerun_queries = lappend(estate->rerun_queries, rq);
+
+	MemoryContextSwitchTo(oldcontext);
+
+	return rq;
+}
+
+/*
+ * Shut down the executor of a rerun_queries entry, if it has one
+ *
+ * If the entry failed, the executor is in no state to be shut down
+ * normally, so we just release everything it holds, as for a failed
+ * portal.
+ */
+static void
+exec_stop_rerun_query(PLpgSQL_rerun_query *rq)
+{
+	if (rq->failed)
+	{
+		ResourceOwnerRelease(rq->owner,
+							 RESOURCE_RELEASE_BEFORE_LOCKS,
+							 false, false);
+		ResourceOwnerRelease(rq->owner,
+							 RESOURCE_RELEASE_LOCKS,
+							 false, false);
+		ResourceOwnerRelease(rq->owner,
+							 RESOURCE_RELEASE_AFTER_LOCKS,
+							 false, false);
+	}
+	else if (rq->cplan != NULL)
+	{
+		ResourceOwner oldowner = CurrentResourceOwner;
+
+		CurrentResourceOwner = rq->owner;
+		if (rq->qdesc != NULL)
+		{
+			ExecutorFinish(rq->qdesc);
+			ExecutorEnd(rq->qdesc);
+			FreeQueryDesc(rq->qdesc);
+		}
+		ReleaseCachedPlan(rq->cplan, true);
+		CurrentResourceOwner = oldowner;
+	}
+
+	MemoryContextReset(rq->cxt);
+	rq->cplan = NULL;
+	rq->qdesc = NULL;
+	rq->rerunnable = false;
+	rq->failed = false;
+}
+
+/*
+ * Shut down the executors of all rerun_queries entries
+ *
+ * The entries themselves are kept, so the statements start a new executor
+ * the next time around.
+ */
+static void
+exec_stop_rerun_queries(PLpgSQL_execstate *estate)
+{
+	ListCell   *lc;
+
+	foreach(lc, estate->rerun_queries)
+		exec_stop_rerun_query((PLpgSQL_rerun_query *) lfirst(lc));
+}
+
+/*
+ * Get rid of the rerun_queries entries of loops deeper than loop_depth
+ *
+ * If the entries' resource owners are already gone, because the
+ * subtransaction they belonged to was aborted, pass release = false.
+ */
+static void
+exec_end_rerun_queries(PLpgSQL_execstate *estate, int loop_depth,
+					   bool release)
+{
+	ListCell   *lc;
+	ListCell   *next;
+	ListCell   *prev = NULL;
+
+	for (lc = list_head(estate->rerun_queries); lc != NULL; lc = next)
+	{
+		PLpgSQL_rerun_query *rq = (PLpgSQL_rerun_query *) lfirst(lc);
+
+		next = lnext(lc);
+		if (rq->loop_depth <= loop_depth)
+		{
+			prev = lc;
+			continue;
+		}
+
+		if (release)
+		{
+			exec_stop_rerun_query(rq);
+			ResourceOwnerRelease(rq->owner,
+								 RESOURCE_RELEASE_BEFORE_LOCKS,
+								 true, false);
+			ResourceOwnerRelease(rq->owner,
+								 RESOURCE_RELEASE_LOCKS,
+								 true, false);
+			ResourceOwnerRelease(rq->owner,
+								 RESOURCE_RELEASE_AFTER_LOCKS,
+								 true, false);
+			ResourceOwnerDelete(rq->owner);
+		}
+		MemoryContextDelete(rq->cxt);
+		pfree(rq);
+		estate->rerun_queries = list_delete_cell(estate->rerun_queries,
+												 lc, prev);
+	}
+}
+
+/*
+ * DestReceiver callbacks for exec_stmt_execsql_rerun: keep a copy of the
+ * first row only; the executor counts the rows for us.
+ */
+static void
+plpgsql_into_receive(TupleTableSlot *slot, DestReceiver *self)
+{
+	PLpgSQL_into_receiver *receiver = (PLpgSQL_into_receiver *) self;
+	MemoryContext oldcontext;
+
+	if (receiver->tuple != NULL)
+		return;
+
+	oldcontext = MemoryContextSwitchTo(receiver->cxt);
+	receiver->tuple = ExecCopySlotTuple(slot);
+	MemoryContextSwitchTo(oldcontext);
+}
+
+static void
+plpgsql_into_startup(DestReceiver *self, int operation, TupleDesc typeinfo)
+{
+	/* nothing to do */
+}
+
+static void
+plpgsql_into_shutdown(DestReceiver *self)
+{
+	/* nothing to do */
+}
+
+/*
+ * Error context callback for queries run by exec_stmt_execsql_rerun; this
+ * must produce the same context as SPI's _SPI_error_callback.
+ */
+static void
+plpgsql_sql_error_callback(void *arg)
+{
+	const char *query = (const char *) arg;
+	int			syntaxerrposition;
+
+	/*
+	 * If there is a syntax error position, convert to internal syntax error;
+	 * otherwise treat the query as an item of context stack
+	 */
+	syntaxerrposition = geterrposition();
+	if (syntaxerrposition > 0)
+	{
+		errposition(0);
+		internalerrposition(syntaxerrposition);
+		internalerrquery(query);
+	}
+	else
+		errcontext("SQL statement \"%s\"", query);
 }
 
 
@@ -3650,6 +4177,9 @@ exec_stmt_dynexecute(PLpgSQL_execstate *estate,
 
 	exec_eval_cleanup(estate);
 
+	/* The string may well be a utility command; see exec_stmt_execsql */
+	exec_stop_rerun_queries(estate);
+
 	/*
 	 * Execute the query without preparing a saved plan.
 	 */
@@ -4318,13 +4848,9 @@ exec_assign_value(PLpgSQL_execstate *estate,
 				PLpgSQL_recfield *recfield = (PLpgSQL_recfield *) target;
 				PLpgSQL_rec *rec;
 				int			fno;
-				HeapTuple	newtup;
-				int			natts;
-				Datum	   *values;
-				bool	   *nulls;
-				bool	   *replaces;
-				Oid			atttype;
-				int32		atttypmod;
+				Form_pg_attribute attr;
+				Datum		newvalue;
+				MemoryContext oldcontext;
 
 				rec = (PLpgSQL_rec *) (estate->datums[recfield->recparentno]);
 
@@ -4341,9 +4867,9 @@ exec_assign_value(PLpgSQL_execstate *estate,
 						   errdetail("The tuple structure of a not-yet-assigned record is indeterminate.")));
 
 				/*
-				 * Get the number of the records field to change and the
-				 * number of attributes in the tuple.  Note: disallow system
-				 * column names because the code below won't cope.
+				 * Get the number of the records field to change.  Note:
+				 * disallow system column names because the code below won't
+				 * cope.
 				 */
 				fno = SPI_fnumber(rec->tupdesc, recfield->fieldname);
 				if (fno <= 0)
@@ -4352,51 +4878,41 @@ exec_assign_value(PLpgSQL_execstate *estate,
 							 errmsg("record \"%s\" has no field \"%s\"",
 									rec->refname, recfield->fieldname)));
 				fno--;
-				natts = rec->tupdesc->natts;
-
-				/*
-				 * Set up values/control arrays for heap_modify_tuple. For all
-				 * the attributes except the one we want to replace, use the
-				 * value that's in the old tuple.
-				 */
-				values = palloc(sizeof(Datum) * natts);
-				nulls = palloc(sizeof(bool) * natts);
-				replaces = palloc(sizeof(bool) * natts);
-
-				memset(replaces, false, sizeof(bool) * natts);
-				replaces[fno] = true;
+				attr = rec->tupdesc->attrs[fno];
 
 				/*
-				 * Now insert the new value, being careful to cast it to the
-				 * right type.
+				 * Now cast the new value to the right type, and copy it into
+				 * the datum context before touching the record, so that an
+				 * error leaves the old value intact.
 				 */
-				atttype = rec->tupdesc->attrs[fno]->atttypid;
-				atttypmod = rec->tupdesc->attrs[fno]->atttypmod;
-				values[fno] = exec_cast_value(estate,
-											  value,
-											  &isNull,
-											  valtype,
-											  valtypmod,
-											  atttype,
-											  atttypmod);
-				nulls[fno] = isNull;
+				newvalue = exec_cast_value(estate,
+										   value,
+										   &isNull,
+										   valtype,
+										   valtypmod,
+										   attr->atttypid,
+										   attr->atttypmod);
+				if (!isNull && !attr->attbyval)
+				{
+					oldcontext = MemoryContextSwitchTo(estate->datum_context);
+					newvalue = datumCopy(newvalue, false, attr->attlen);
+					MemoryContextSwitchTo(oldcontext);
+				}
 
 				/*
-				 * Now call heap_modify_tuple() to create a new tuple that
-				 * replaces the old one in the record.
+				 * Store the value into the broken-out fields of the record,
+				 * rather than forming a whole new tuple for each assignment.
+				 * The tuple is formed again only when the record is used as
+				 * a whole.
 				 */
-				newtup = heap_modify_tuple(rec->tup, rec->tupdesc,
-										   values, nulls, replaces);
-
-				if (rec->freetup)
-					heap_freetuple(rec->tup);
-
-				rec->tup = newtup;
-				rec->freetup = true;
-
-				pfree(values);
-				pfree(nulls);
-				pfree(replaces);
+				if (rec->fvalues == NULL)
+					exec_rec_deform(estate, rec);
+				if (rec->ffree[fno])
+					pfree(DatumGetPointer(rec->fvalues[fno]));
+				rec->fvalues[fno] = newvalue;
+				rec->fnulls[fno] = isNull;
+				rec->ffree[fno] = (!isNull && !attr->attbyval);
+				rec->modified = true;
 
 				break;
 			}
@@ -4668,6 +5184,7 @@ exec_eval_datum(PLpgSQL_execstate *estate,
 								  rec->refname),
 						   errdetail("The tuple structure of a not-yet-assigned record is indeterminate.")));
 				Assert(rec->tupdesc != NULL);
+				exec_rec_flatten(estate, rec);
 				/* Make sure we have a valid type/typmod setting */
 				BlessTupleDesc(rec->tupdesc);
 
@@ -4704,7 +5221,14 @@ exec_eval_datum(PLpgSQL_execstate *estate,
 					*typetypmod = rec->tupdesc->attrs[fno - 1]->atttypmod;
 				else
 					*typetypmod = -1;
-				*value = SPI_getbinval(rec->tup, rec->tupdesc, fno, isnull);
+				if (fno > 0 && rec->fvalues != NULL)
+				{
+					/* use the broken-out value, which may be newer */
+					*value = rec->fvalues[fno - 1];
+					*isnull = rec->fnulls[fno - 1];
+				}
+				else
+					*value = SPI_getbinval(rec->tup, rec->tupdesc, fno, isnull);
 				break;
 			}
 
@@ -5571,6 +6095,95 @@ plpgsql_param_fetch(ParamListInfo params, int paramid)
 }
 
 
+/* ----------
+ * exec_rec_deform			Break out a record's tuple into its field arrays
+ *
+ * The arrays live in the datum context.  Pass-by-reference values that have
+ * not been assigned keep pointing into rec->tup, so the tuple must stay
+ * around until the record is flattened or reassigned.
+ * ----------
+ */
+static void
+exec_rec_deform(PLpgSQL_execstate *estate, PLpgSQL_rec *rec)
+{
+	int			natts = rec->tupdesc->natts;
+	MemoryContext oldcontext;
+
+	Assert(HeapTupleIsValid(rec->tup));
+	Assert(rec->fvalues == NULL);
+
+	oldcontext = MemoryContextSwitchTo(estate->datum_context);
+	rec->fvalues = (Datum *) palloc(natts * sizeof(Datum));
+	rec->fnulls = (bool *) palloc(natts * sizeof(bool));
+	rec->ffree = (bool *) palloc0(natts * sizeof(bool));
+	MemoryContextSwitchTo(oldcontext);
+
+	heap_deform_tuple(rec->tup, rec->tupdesc, rec->fvalues, rec->fnulls);
+	rec->modified = false;
+}
+
+/* ----------
+ * exec_rec_flatten			Form a record's tuple again from its fields
+ *
+ * This is a no-op unless a field has been assigned since the tuple was
+ * last formed.
+ * ----------
+ */
+static void
+exec_rec_flatten(PLpgSQL_execstate *estate, PLpgSQL_rec *rec)
+{
+	HeapTuple	newtup;
+	MemoryContext oldcontext;
+
+	if (rec->fvalues == NULL || !rec->modified)
+		return;
+
+	oldcontext = MemoryContextSwitchTo(estate->datum_context);
+	newtup = heap_form_tuple(rec->tupdesc, rec->fvalues, rec->fnulls);
+	MemoryContextSwitchTo(oldcontext);
+
+	/* copy the identification info of the old tuple, as heap_modify_tuple */
+	newtup->t_data->t_ctid = rec->tup->t_data->t_ctid;
+	newtup->t_self = rec->tup->t_self;
+	newtup->t_tableOid = rec->tup->t_tableOid;
+	if (rec->tupdesc->tdhasoid)
+		HeapTupleSetOid(newtup, HeapTupleGetOid(rec->tup));
+
+	exec_rec_free_fields(rec);
+	if (rec->freetup)
+		heap_freetuple(rec->tup);
+	rec->tup = newtup;
+	rec->freetup = true;
+}
+
+/* ----------
+ * exec_rec_free_fields		Discard a record's broken-out fields
+ *
+ * Assignments not yet flattened into the tuple are lost.
+ * ----------
+ */
+static void
+exec_rec_free_fields(PLpgSQL_rec *rec)
+{
+	int			i;
+
+	if (rec->fvalues == NULL)
+		return;
+
+	for (i = 0; i < rec->tupdesc->natts; i++)
+	{
+		if (rec->ffree[i])
+			pfree(DatumGetPointer(rec->fvalues[i]));
+	}
+	pfree(rec->fvalues);
+	pfree(rec->fnulls);
+	pfree(rec->ffree);
+	rec->fvalues = NULL;
+	rec->fnulls = NULL;
+	rec->ffree = NULL;
+	rec->modified = false;
+}
+
 /* ----------
  * exec_move_row			Move one tuple's values into a record or row
  *
@@ -5612,6 +6225,7 @@ exec_move_row(PLpgSQL_execstate *estate,
 			tupdesc = CreateTupleDescCopy(tupdesc);
 
 		/* Free the old value ... */
+		exec_rec_free_fields(rec);
 		if (rec->freetup)
 		{
 			heap_freetuple(rec->tup);
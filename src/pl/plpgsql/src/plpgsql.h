@@ -297,6 +297,20 @@ typedef struct
 	TupleDesc	tupdesc;
 	bool		freetup;
 	bool		freetupdesc;
+
+	/*
+	 * Once a field of the record has been assigned to, the tuple is kept
+	 * broken out into these arrays (allocated in the function's datum
+	 * context) so that further field assignments are done in place rather
+	 * than by copying the whole tuple.  ffree[i] is true if fvalues[i] is a
+	 * separately palloc'd copy; the other pass-by-reference values still
+	 * point into tup.  The tuple is formed again when "modified" and the
+	 * whole record is needed.
+	 */
+	Datum	   *fvalues;
+	bool	   *fnulls;
+	bool	   *ffree;
+	bool		modified;
 } PLpgSQL_rec;
 
 
@@ -647,7 +661,8 @@ typedef struct
 	int			lineno;
 	PLpgSQL_expr *sqlstmt;
 	bool		mod_stmt;		/* is the stmt INSERT/UPDATE/DELETE? */
-	/* note: mod_stmt is set when we plan the query */
+	bool		utility_stmt;	/* does the stmt include a utility command? */
+	/* note: mod_stmt and utility_stmt are set when we plan the query */
 	bool		into;			/* INTO supplied? */
 	bool		strict;			/* INTO STRICT flag */
 	PLpgSQL_rec *rec;			/* INTO target, if record */
@@ -793,6 +808,7 @@ typedef struct PLpgSQL_execstate
 	int			found_varno;
 	int			ndatums;
 	PLpgSQL_datum **datums;
+	MemoryContext datum_context;	/* where long-lived values are kept */
 
 	/* we pass datums[i] to the executor, when needed, in paramLI->params[i] */
 	ParamListInfo paramLI;
@@ -800,6 +816,16 @@ typedef struct PLpgSQL_execstate
 	/* EState to use for "simple" expression evaluation */
 	EState	   *simple_eval_estate;
 
+	/*
+	 * SELECT INTO statements executed inside loops, whose executors are
+	 * kept between iterations (see exec_stmt_execsql_rerun); loop_depth is
+	 * the nesting level of the innermost loop being executed, and
+	 * loop_owner the resource owner that was current when it was entered.
+	 */
+	List	   *rerun_queries;
+	int			loop_depth;
+	ResourceOwner loop_owner;
+
 	/* temporary state for results from evaluation of query or expr */
 	SPITupleTable *eval_tuptable;
 	uint32		eval_processed;
@@ -0,0 +1,50 @@
+/* src/test/bench/bench_hotpath--1.0.sql */
+
+-- complain if script is sourced in psql, rather than via CREATE EXTENSION
+\echo Use "CREATE EXTENSION bench_hotpath" to load this file. \quit
+
+-- All of these return the average time per operation, in nanoseconds.
+
+CREATE FUNCTION bench_hash_any(loops pg_catalog.int4,
+					   keylen pg_catalog.int4)
+    RETURNS pg_catalog.float8 STRICT
+	AS 'MODULE_PATHNAME' LANGUAGE C;
+
+CREATE FUNCTION bench_hash_any_fast(loops pg_catalog.int4,
+					   keylen pg_catalog.int4)
+    RETURNS pg_catalog.float8 STRICT
+	AS 'MODULE_PATHNAME' LANGUAGE C;
+
+CREATE FUNCTION bench_tuplesort(loops pg_catalog.int4,
+					   ntuples pg_catalog.int4)
+    RETURNS pg_catalog.float8 STRICT
+	AS 'MODULE_PATHNAME' LANGUAGE C;
+
+CREATE FUNCTION bench_heap_deform(loops pg_catalog.int4,
+					   rel pg_catalog.regclass)
+    RETURNS pg_catalog.float8 STRICT
+	AS 'MODULE_PATHNAME' LANGUAGE C;
+
+CREATE FUNCTION bench_lwlock(loops pg_catalog.int4,
+					   exclusive pg_catalog.bool default true)
+    RETURNS pg_catalog.float8 STRICT
+	AS 'MODULE_PATHNAME' LANGUAGE C;
+
+CREATE FUNCTION bench_wal_insert(loops pg_catalog.int4,
+					   recsize pg_catalog.int4)
+    RETURNS pg_catalog.float8 STRICT
+	AS 'MODULE_PATHNAME' LANGUAGE C;
+
+CREATE FUNCTION bench_pin_buffer(loops pg_catalog.int4,
+					   rel pg_catalog.regclass)
+    RETURNS pg_catalog.float8 STRICT
+	AS 'MODULE_PATHNAME' LANGUAGE C;
+
+-- These can write WAL and hog the CPU, so don't let just anyone run them.
+REVOKE ALL ON FUNCTION bench_hash_any(int4, int4) FROM PUBLIC;
+REVOKE ALL ON FUNCTION bench_hash_any_fast(int4, int4) FROM PUBLIC;
+REVOKE ALL ON FUNCTION bench_tuplesort(int4, int4) FROM PUBLIC;
+REVOKE ALL ON FUNCTION bench_heap_deform(int4, regclass) FROM PUBLIC;
+REVOKE ALL ON FUNCTION bench_lwlock(int4, bool) FROM PUBLIC;
+REVOKE ALL ON FUNCTION bench_wal_insert(int4, int4) FROM PUBLIC;
+REVOKE ALL ON FUNCTION bench_pin_buffer(int4, regclass) FROM PUBLIC;
@@ -0,0 +1,488 @@
+/*--------------------------------------------------------------------------
+ *
+ * bench_hotpath.c
+ *		Micro-benchmarks of hot code paths of the backend.
+ *
+ * Each function runs one low-level operation in a tight loop and returns
+ * the average time per operation in nanoseconds.  They are driven by
+ * run_bench.pl, but can also be called by hand.  The numbers are only
+ * meaningful relative to each other, for the same machine and build.
+ *
+ * Copyright (c) 2015, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		src/test/bench/bench_hotpath.c
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/hash.h"
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "access/xlog.h"
+#include "access/xloginsert.h"
+#include "catalog/pg_control.h"
+#include "catalog/pg_operator.h"
+#include "catalog/pg_type.h"
+#include "fmgr.h"
+#include "miscadmin.h"
+#include "portability/instr_time.h"
+#include "storage/bufmgr.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+#include "utils/tuplesort.h"
+
+PG_MODULE_MAGIC;
+
+PG_FUNCTION_INFO_V1(bench_hash_any);
+PG_FUNCTION_INFO_V1(bench_hash_any_fast);
+PG_FUNCTION_INFO_V1(bench_tuplesort);
+PG_FUNCTION_INFO_V1(bench_heap_deform);
+PG_FUNCTION_INFO_V1(bench_lwlock);
+PG_FUNCTION_INFO_V1(bench_wal_insert);
+PG_FUNCTION_INFO_V1(bench_pin_buffer);
+
+void		_PG_init(void);
+
+/* Most tuples bench_heap_deform keeps in memory */
+#define BENCH_DEFORM_MAX_TUPLES		10000
+
+/* Largest record bench_wal_insert will write */
+#define BENCH_WAL_MAX_RECORD		(1024 * 1024)
+
+/*
+ * When loaded via shared_preload_libraries, we allocate an LWLock in shared
+ * memory, so that bench_lwlock can be run in several sessions at once to
+ * measure contention.  Otherwise, it uses a lock in backend-local memory.
+ */
+typedef struct BenchSharedState
+{
+	LWLock	   *lock;
+} BenchSharedState;
+
+static BenchSharedState *bench_state = NULL;
+static LWLock *bench_local_lock = NULL;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+/* Results are stored here, so that the compiler can't optimize loops away */
+static volatile uint32 bench_sink;
+
+static void bench_shmem_startup(void);
+static void check_loops(int32 loops);
+
+
+/*
+ * Module load callback
+ */
+void
+_PG_init(void)
+{
+	if (!process_shared_preload_libraries_in_progress)
+		return;
+
+	RequestAddinShmemSpace(MAXALIGN(sizeof(BenchSharedState)));
+	RequestAddinLWLocks(1);
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = bench_shmem_startup;
+}
+
+/*
+ * shmem_startup hook: allocate or attach to shared memory.
+ */
+static void
+bench_shmem_startup(void)
+{
+	bool		found;
+
+	if (prev_shmem_startup_hook)
+		prev_shmem_startup_hook();
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	bench_state = ShmemInitStruct("bench_hotpath",
+								  sizeof(BenchSharedState),
+								  &found);
+	if (!found)
+		bench_state->lock = LWLockAssign();
+
+	LWLockRelease(AddinShmemInitLock);
+}
+
+static void
+check_loops(int32 loops)
+{
+	if (loops <= 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("number of loops must be greater than zero")));
+}
+
+/*
+ * Return the nanoseconds per operation taken by nops operations, started at
+ * start_time.
+ */
+static Datum
+bench_result(instr_time start_time, double nops)
+{
+	instr_time	duration;
+
+	INSTR_TIME_SET_CURRENT(duration);
+	INSTR_TIME_SUBTRACT(duration, start_time);
+
+	PG_RETURN_FLOAT8(INSTR_TIME_GET_DOUBLE(duration) * 1e9 / nops);
+}
+
+/*
+ * Fill a buffer with arbitrary, but reproducible, bytes.
+ */
+static char *
+bench_key(int32 keylen)
+{
+	char	   *key;
+	int			i;
+
+	if (keylen <= 0 || keylen > BLCKSZ)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("key length must be between 1 and %d", BLCKSZ)));
+
+	key = palloc(keylen);
+	for (i = 0; i < keylen; i++)
+		key[i] = (char) (i * 31 + 7);
+
+	return key;
+}
+
+/*
+ * bench_hash_any(loops int4, keylen int4) returns float8
+ *
+ * Time hash_any() on a key of keylen bytes.
+ */
+Datum
+bench_hash_any(PG_FUNCTION_ARGS)
+{
+	int32		loops = PG_GETARG_INT32(0);
+	int32		keylen = PG_GETARG_INT32(1);
+	unsigned char *key;
+	instr_time	start_time;
+	uint32		h = 0;
+	int32		i;
+
+	check_loops(loops);
+	key = (unsigned char *) bench_key(keylen);
+
+	INSTR_TIME_SET_CURRENT(start_time);
+	for (i = 0; i < loops; i++)
+	{
+		/* feed the previous result back in, to serialize the calls */
+		key[0] = (unsigned char) h;
+		h = DatumGetUInt32(hash_any(key, keylen));
+	}
+	bench_sink = h;
+
+	return bench_result(start_time, loops);
+}
+
+/*
+ * bench_hash_any_fast(loops int4, keylen int4) returns float8
+ *
+ * Same as bench_hash_any, for hash_any_fast().
+ */
+Datum
+bench_hash_any_fast(PG_FUNCTION_ARGS)
+{
+	int32		loops = PG_GETARG_INT32(0);
+	int32		keylen = PG_GETARG_INT32(1);
+	unsigned char *key;
+	instr_time	start_time;
+	uint32		h = 0;
+	int32		i;
+
+	check_loops(loops);
+	key = (unsigned char *) bench_key(keylen);
+
+	INSTR_TIME_SET_CURRENT(start_time);
+	for (i = 0; i < loops; i++)
+	{
+		key[0] = (unsigned char) h;
+		h = DatumGetUInt32(hash_any_fast(key, keylen));
+	}
+	bench_sink = h;
+
+	return bench_result(start_time, loops);
+}
+
+/*
+ * bench_tuplesort(loops int4, ntuples int4) returns float8
+ *
+ * Time sorting ntuples pseudo-random int8 datums with a tuplesort, loops
+ * times.  The result is per tuple sorted.  work_mem applies as usual, so the
+ * caller can choose between an in-memory and an external sort.
+ */
+Datum
+bench_tuplesort(PG_FUNCTION_ARGS)
+{
+	int32		loops = PG_GETARG_INT32(0);
+	int32		ntuples = PG_GETARG_INT32(1);
+	MemoryContext sortcontext;
+	MemoryContext oldcontext;
+	instr_time	start_time;
+	uint64		seed = 1;
+	int32		i;
+
+	check_loops(loops);
+	if (ntuples <= 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("number of tuples must be greater than zero")));
+
+	sortcontext = AllocSetContextCreate(CurrentMemoryContext,
+										"bench_tuplesort",
+										ALLOCSET_DEFAULT_MINSIZE,
+										ALLOCSET_DEFAULT_INITSIZE,
+										ALLOCSET_DEFAULT_MAXSIZE);
+	oldcontext = MemoryContextSwitchTo(sortcontext);
+
+	INSTR_TIME_SET_CURRENT(start_time);
+	for (i = 0; i < loops; i++)
+	{
+		Tuplesortstate *sortstate;
+		Datum		val;
+		bool		isnull;
+		int32		j;
+
+		sortstate = tuplesort_begin_datum(INT8OID, Int8LessOperator,
+										  InvalidOid, false,
+										  work_mem, false);
+
+		for (j = 0; j < ntuples; j++)
+		{
+			/* a 64-bit LCG, see Knuth */
+			seed = seed * UINT64CONST(6364136223846793005) +
+				UINT64CONST(1442695040888963407);
+			tuplesort_putdatum(sortstate, Int64GetDatum((int64) (seed >> 1)),
+							   false);
+		}
+
+		tuplesort_performsort(sortstate);
+
+		while (tuplesort_getdatum(sortstate, true, &val, &isnull))
+			bench_sink += (uint32) DatumGetInt64(val);
+
+		tuplesort_end(sortstate);
+		MemoryContextReset(sortcontext);
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	MemoryContextSwitchTo(oldcontext);
+	MemoryContextDelete(sortcontext);
+
+	return bench_result(start_time, (double) loops * ntuples);
+}
+
+/*
+ * bench_heap_deform(loops int4, rel regclass) returns float8
+ *
+ * Time heap_deform_tuple() on the tuples of a table.  Up to
+ * BENCH_DEFORM_MAX_TUPLES of them are copied to local memory first, so that
+ * only the deforming is measured.  The result is per tuple deformed.
+ */
+Datum
+bench_heap_deform(PG_FUNCTION_ARGS)
+{
+	int32		loops = PG_GETARG_INT32(0);
+	Oid			relid = PG_GETARG_OID(1);
+	Relation	rel;
+	TupleDesc	tupdesc;
+	HeapScanDesc scan;
+	HeapTuple	tuple;
+	HeapTuple  *tuples;
+	int			ntuples = 0;
+	Datum	   *values;
+	bool	   *isnull;
+	instr_time	start_time;
+	int32		i;
+
+	check_loops(loops);
+
+	rel = heap_open(relid, AccessShareLock);
+	tupdesc = RelationGetDescr(rel);
+
+	tuples = palloc(BENCH_DEFORM_MAX_TUPLES * sizeof(HeapTuple));
+	scan = heap_beginscan(rel, GetActiveSnapshot(), 0, NULL);
+	while (ntuples < BENCH_DEFORM_MAX_TUPLES &&
+		   (tuple = heap_getnext(scan, ForwardScanDirection)) != NULL)
+		tuples[ntuples++] = heap_copytuple(tuple);
+	heap_endscan(scan);
+
+	if (ntuples == 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("table \"%s\" is empty",
+						RelationGetRelationName(rel))));
+
+	values = palloc(tupdesc->natts * sizeof(Datum));
+	isnull = palloc(tupdesc->natts * sizeof(bool));
+
+	INSTR_TIME_SET_CURRENT(start_time);
+	for (i = 0; i < loops; i++)
+	{
+		int			j;
+
+		for (j = 0; j < ntuples; j++)
+			heap_deform_tuple(tuples[j], tupdesc, values, isnull);
+
+		CHECK_FOR_INTERRUPTS();
+	}
+	bench_sink = (uint32) values[0];
+
+	heap_close(rel, AccessShareLock);
+
+	return bench_result(start_time, (double) loops * ntuples);
+}
+
+/*
+ * bench_lwlock(loops int4, exclusive bool) returns float8
+ *
+ * Time acquiring and releasing an LWLock in the given mode.  If the module
+ * was loaded via shared_preload_libraries, all sessions use the same lock,
+ * so running this in several sessions at once measures contention.
+ */
+Datum
+bench_lwlock(PG_FUNCTION_ARGS)
+{
+	int32		loops = PG_GETARG_INT32(0);
+	LWLockMode	mode = PG_GETARG_BOOL(1) ? LW_EXCLUSIVE : LW_SHARED;
+	LWLock	   *lock;
+	instr_time	start_time;
+	int32		i;
+
+	check_loops(loops);
+
+	if (bench_state != NULL)
+		lock = bench_state->lock;
+	else
+	{
+		if (bench_local_lock == NULL)
+		{
+			static LWLockTranche tranche;
+			int			tranche_id = LWLockNewTrancheId();
+
+			bench_local_lock = MemoryContextAlloc(TopMemoryContext,
+												  sizeof(LWLock));
+			tranche.name = "bench_hotpath";
+			tranche.array_base = bench_local_lock;
+			tranche.array_stride = sizeof(LWLock);
+			LWLockRegisterTranche(tranche_id, &tranche);
+			LWLockInitialize(bench_local_lock, tranche_id);
+		}
+		lock = bench_local_lock;
+	}
+
+	INSTR_TIME_SET_CURRENT(start_time);
+	for (i = 0; i < loops; i++)
+	{
+		LWLockAcquire(lock, mode);
+		LWLockRelease(lock);
+	}
+
+	return bench_result(start_time, loops);
+}
+
+/*
+ * bench_wal_insert(loops int4, recsize int4) returns float8
+ *
+ * Time inserting no-op WAL records with recsize bytes of payload.  The
+ * records are not flushed, so this measures WAL insertion only.
+ */
+Datum
+bench_wal_insert(PG_FUNCTION_ARGS)
+{
+	int32		loops = PG_GETARG_INT32(0);
+	int32		recsize = PG_GETARG_INT32(1);
+	char	   *payload;
+	instr_time	start_time;
+	int32		i;
+
+	check_loops(loops);
+	if (recsize <= 0 || recsize > BENCH_WAL_MAX_RECORD)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("record size must be between 1 and %d",
+						BENCH_WAL_MAX_RECORD)));
+	if (RecoveryInProgress())
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("recovery is in progress"),
+				 errhint("WAL can't be written during recovery.")));
+
+	payload = palloc0(recsize);
+
+	INSTR_TIME_SET_CURRENT(start_time);
+	for (i = 0; i < loops; i++)
+	{
+		XLogBeginInsert();
+		XLogRegisterData(payload, recsize);
+		(void) XLogInsert(RM_XLOG_ID, XLOG_NOOP);
+
+		if (i % 1024 == 0)
+			CHECK_FOR_INTERRUPTS();
+	}
+
+	return bench_result(start_time, loops);
+}
+
+/*
+ * bench_pin_buffer(loops int4, rel regclass) returns float8
+ *
+ * Time looking up, pinning and unpinning the blocks of a table that is
+ * already in shared buffers, in turn.  This is the ReadBuffer() fast path,
+ * which ends in PinBuffer().
+ */
+Datum
+bench_pin_buffer(PG_FUNCTION_ARGS)
+{
+	int32		loops = PG_GETARG_INT32(0);
+	Oid			relid = PG_GETARG_OID(1);
+	Relation	rel;
+	BlockNumber nblocks;
+	instr_time	start_time;
+	int32		i;
+
+	check_loops(loops);
+
+	rel = heap_open(relid, AccessShareLock);
+	nblocks = RelationGetNumberOfBlocks(rel);
+	if (nblocks == 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("table \"%s\" is empty",
+						RelationGetRelationName(rel))));
+
+	/* Make sure all the blocks are in shared buffers */
+	for (i = 0; i < nblocks; i++)
+		ReleaseBuffer(ReadBuffer(rel, i));
+
+	INSTR_TIME_SET_CURRENT(start_time);
+	for (i = 0; i < loops; i++)
+	{
+		Buffer		buf = ReadBuffer(rel, i % nblocks);
+
+		ReleaseBuffer(buf);
+
+		if (i % 1024 == 0)
+			CHECK_FOR_INTERRUPTS();
+	}
+
+	heap_close(rel, AccessShareLock);
+
+	return bench_result(start_time, loops);
+}
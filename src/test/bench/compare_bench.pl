@@ -0,0 +1,77 @@
+#!/usr/bin/perl
+#
+# compare_bench.pl
+#		Compare two result files of run_bench.pl.
+#
+# Prints every benchmark found in both files, with the relative change from
+# the old to the new result, and flags the changes for the worse that are
+# larger than the threshold.  Results in units per second, or tps, are
+# better when higher, all others when lower.  Exits with status 1 if
+# anything was flagged, so that this can be used to catch regressions
+# automatically.
+#
+# src/test/bench/compare_bench.pl
+
+use strict;
+use warnings;
+
+use Getopt::Long;
+
+my $threshold = 5;
+
+GetOptions('threshold=f' => \$threshold)
+  or die "Usage: $0 [--threshold=PERCENT] OLD NEW\n";
+die "Usage: $0 [--threshold=PERCENT] OLD NEW\n" unless @ARGV == 2;
+
+my ($old, $old_order) = read_results($ARGV[0]);
+my ($new) = read_results($ARGV[1]);
+my $regressions = 0;
+
+printf "%-10s %-28s %14s %14s %9s\n", 'suite', 'benchmark', 'old', 'new',
+  'change';
+
+foreach my $key (@$old_order)
+{
+	next unless exists $new->{$key};
+
+	my ($oldval, $unit) = @{ $old->{$key} };
+	my ($newval) = @{ $new->{$key} };
+	my ($suite, $name) = split /\t/, $key;
+	my $change = $oldval != 0 ? ($newval - $oldval) * 100.0 / $oldval : 0;
+	my $worse = $unit =~ m{(/s|^tps)$} ? -$change : $change;
+	my $flag = '';
+
+	if ($worse > $threshold)
+	{
+		$flag = '  REGRESSION';
+		$regressions++;
+	}
+
+	printf "%-10s %-28s %14.3f %14.3f %+8.1f%% %s%s\n", $suite, $name,
+	  $oldval, $newval, $change, $unit, $flag;
+}
+
+exit($regressions > 0 ? 1 : 0);
+
+sub read_results
+{
+	my $file = shift;
+	my %results;
+	my @order;
+
+	open my $fh, '<', $file or die "could not open \"$file\": $!\n";
+	while (my $line = <$fh>)
+	{
+		chomp $line;
+		next if $line =~ /^#/ || $line =~ /^suite\t/ || $line eq '';
+
+		my ($suite, $name, $value, $unit) = split /\t/, $line;
+		die "invalid line in \"$file\": $line\n" unless defined $unit;
+
+		push @order, "$suite\t$name";
+		$results{"$suite\t$name"} = [ $value, $unit ];
+	}
+	close $fh;
+
+	return (\%results, \@order);
+}
@@ -0,0 +1,407 @@
+#!/usr/bin/perl
+#
+# run_bench.pl
+#		Run the benchmark suite and write the results in machine-readable form.
+#
+# With --temp-instance, a scratch cluster is created in the given directory
+# and removed at the end; otherwise the benchmarks run against the server and
+# database that libpq's environment variables point to.  Either way, the
+# PATH must lead to the initdb, pg_ctl, psql and pgbench to use.
+#
+# All the objects the benchmarks create are in the schema "bench", which is
+# dropped and recreated at the start.
+#
+# The results are written as tab-separated lines of suite, benchmark, value
+# and unit, after a header line and some "#" comment lines describing the
+# run.  compare_bench.pl compares two such files.
+#
+# src/test/bench/run_bench.pl
+
+use strict;
+use warnings;
+
+use File::Path qw(mkpath rmtree);
+use File::Spec;
+use File::Temp qw(tempdir);
+use Getopt::Long;
+use POSIX qw(strftime);
+use Time::HiRes qw(time);
+
+my %opt = (
+	'suites'   => 'micro,analytics,oltp,copy',
+	'scale'    => 1,
+	'loops'    => 1,
+	'runs'     => 3,
+	'clients'  => 16,
+	'jobs'     => 0,
+	'duration' => 30,
+	'label'    => '',
+	'output'   => '-',
+	'port'     => 0,
+	'set'      => []);
+
+GetOptions(
+	\%opt,          'suites=s',
+	'scale=i',      'loops=f',
+	'runs=i',       'clients=i',
+	'jobs=i',       'duration=i',
+	'label=s',      'output=s',
+	'temp-instance=s', 'port=i',
+	'set=s@',       'help') or usage();
+usage() if $opt{help};
+
+sub usage
+{
+	print <<EOF;
+Usage: $0 [OPTION]...
+
+  --suites=LIST         comma-separated suites to run, among
+                        micro, analytics, oltp and copy (default: all)
+  --scale=N             size of the analytics, OLTP and COPY data sets
+                        (default: 1)
+  --loops=F             multiply the loop counts of the micro-benchmarks by F
+                        (default: 1)
+  --runs=N              run each micro-benchmark and analytics query N times,
+                        and report the median (default: 3)
+  --clients=N           concurrent sessions for OLTP and contention tests
+                        (default: 16)
+  --jobs=N              pgbench threads (default: same as --clients)
+  --duration=SECS       length of each pgbench run (default: 30)
+  --label=TEXT          label recorded in the output, e.g. a commit hash
+  --output=FILE         write the results to FILE as well as stdout
+  --temp-instance=DIR   create a temporary cluster in DIR
+  --port=PORT           port of the temporary cluster (default: 65432)
+  --set=NAME=VALUE      server setting for the temporary cluster; can be
+                        given more than once
+EOF
+	exit 1;
+}
+
+my %suites = map { $_ => 1 } split /,/, $opt{suites};
+foreach my $suite (keys %suites)
+{
+	die "unknown suite \"$suite\"\n"
+	  unless grep { $_ eq $suite } qw(micro analytics oltp copy);
+}
+$opt{jobs} ||= $opt{clients};
+
+my $devnull = File::Spec->devnull();
+my $tmpdir = tempdir('bench_XXXX', TMPDIR => 1, CLEANUP => 1);
+my $datadir;
+
+# Everything we run uses our schema first
+$ENV{PGOPTIONS} = '-c search_path=bench,public';
+
+if (defined $opt{'temp-instance'})
+{
+	start_temp_instance($opt{'temp-instance'});
+}
+
+END
+{
+	my $exit_code = $?;
+
+	if (defined $datadir)
+	{
+		system('pg_ctl', '-D', $datadir, '-m', 'fast', '-w', 'stop');
+		rmtree($opt{'temp-instance'}) if $exit_code == 0;
+	}
+
+	$? = $exit_code;
+}
+
+my $outfh;
+if ($opt{output} ne '-')
+{
+	open $outfh, '>', $opt{output}
+	  or die "could not open \"$opt{output}\": $!\n";
+}
+
+psql_do('DROP SCHEMA IF EXISTS bench CASCADE');
+psql_do('CREATE SCHEMA bench');
+
+emit("# label: $opt{label}");
+emit("# date: " . strftime('%Y-%m-%d %H:%M:%S %z', localtime));
+emit("# server: " . psql_query('SELECT version()'));
+emit("# scale: $opt{scale}, loops: $opt{loops}, runs: $opt{runs}, "
+	  . "clients: $opt{clients}, jobs: $opt{jobs}, duration: $opt{duration}");
+emit("suite\tbenchmark\tvalue\tunit");
+
+run_micro()     if $suites{micro};
+run_analytics() if $suites{analytics};
+run_oltp()      if $suites{oltp};
+run_copy()      if $suites{copy};
+
+close $outfh if defined $outfh;
+
+exit 0;
+
+
+#
+# Micro-benchmarks of backend hot paths, using the bench_hotpath extension.
+# Each reports nanoseconds per operation.
+#
+sub run_micro
+{
+	psql_file('workloads/micro_setup.sql');
+
+	my @micro = (
+		[ 'hash_any_8',         'SELECT bench_hash_any(%d, 8)',     10000000 ],
+		[ 'hash_any_64',        'SELECT bench_hash_any(%d, 64)',    10000000 ],
+		[ 'hash_any_fast_8',    'SELECT bench_hash_any_fast(%d, 8)', 10000000 ],
+		[ 'hash_any_fast_64',   'SELECT bench_hash_any_fast(%d, 64)', 10000000 ],
+		[ 'tuplesort_int8_memory',
+		  "SET work_mem = '64MB'; SELECT bench_tuplesort(%d, 100000)", 20 ],
+		[ 'tuplesort_int8_external',
+		  "SET work_mem = '1MB'; SELECT bench_tuplesort(%d, 1000000)", 2 ],
+		[ 'heap_deform_narrow',
+		  "SELECT bench_heap_deform(%d, 'bench_narrow')", 500 ],
+		[ 'heap_deform_wide',
+		  "SELECT bench_heap_deform(%d, 'bench_wide')", 200 ],
+		[ 'lwlock_exclusive',   'SELECT bench_lwlock(%d, true)',    10000000 ],
+		[ 'lwlock_shared',      'SELECT bench_lwlock(%d, false)',   10000000 ],
+		[ 'wal_insert_64',      'SELECT bench_wal_insert(%d, 64)',  1000000 ],
+		[ 'wal_insert_8192',    'SELECT bench_wal_insert(%d, 8192)', 100000 ],
+		[ 'pin_buffer',
+		  "SELECT bench_pin_buffer(%d, 'bench_narrow')", 10000000 ]);
+
+	foreach my $bench (@micro)
+	{
+		my ($name, $sql, $loops) = @$bench;
+		my @results;
+
+		$loops = int($loops * $opt{loops}) || 1;
+		for (1 .. $opt{runs})
+		{
+			push @results, psql_query(sprintf($sql, $loops));
+		}
+		emit_result('micro', $name, median(@results), 'ns/op');
+	}
+
+	# The same LWLock hammered from all the clients at once.  This needs
+	# the shared lock that's only there if we're preloaded.
+	if (psql_query("SELECT count(*) FROM pg_settings WHERE name = "
+			. "'shared_preload_libraries' AND setting ~ 'bench_hotpath'"))
+	{
+		my $script = "$tmpdir/lwlock.sql";
+
+		open my $fh, '>', $script or die "could not open \"$script\": $!\n";
+		print $fh "SELECT bench_lwlock(1000, true);\n";
+		close $fh;
+
+		my $tps = pgbench('-n', '-M', 'prepared', '-f', $script);
+		emit_result('micro', 'lwlock_exclusive_contended', $tps * 1000,
+			'ops/s');
+	}
+}
+
+#
+# Analytical queries on a TPC-H-like schema.  Each reports the median
+# execution time in milliseconds, after a warm-up run.
+#
+sub run_analytics
+{
+	psql_file('workloads/analytics_schema.sql', scale => $opt{scale});
+
+	foreach my $file (sort glob('workloads/analytics_q*.sql'))
+	{
+		my ($name) = $file =~ m{analytics_(q\d+)\.sql$};
+		my $sql = slurp($file);
+		my @results;
+
+		psql_timed($sql);
+		for (1 .. $opt{runs})
+		{
+			push @results, psql_timed($sql);
+		}
+		emit_result('analytics', $name, median(@results), 'ms');
+	}
+}
+
+#
+# pgbench's OLTP workloads, at --clients concurrency.  Each reports
+# transactions per second.
+#
+sub run_oltp
+{
+	system_or_die('pgbench', '-i', '-q', '-s', $opt{scale});
+	psql_do('CHECKPOINT');
+
+	emit_result('oltp', 'tpcb_like', pgbench('-n', '-M', 'prepared'), 'tps');
+	emit_result('oltp', 'select_only',
+		pgbench('-n', '-M', 'prepared', '-S'), 'tps');
+}
+
+#
+# Bulk loading with COPY, into a table without and with indexes.  Each
+# reports rows per second, as seen by the client.
+#
+sub run_copy
+{
+	my $datafile = "$tmpdir/copy.data";
+
+	psql_file('workloads/copy_schema.sql', scale => $opt{scale});
+	psql_do("\\copy copy_source TO '$datafile'");
+	my $rows = psql_query('SELECT count(*) FROM copy_source');
+
+	foreach my $table (qw(copy_plain copy_indexed))
+	{
+		psql_do("TRUNCATE $table");
+		psql_do('CHECKPOINT');
+
+		my $start = time();
+		psql_do("\\copy $table FROM '$datafile'");
+		my $elapsed = time() - $start;
+
+		emit_result('copy', $table, $rows / $elapsed, 'rows/s');
+	}
+}
+
+
+sub start_temp_instance
+{
+	my $dir = shift;
+	my $port = $opt{port} || 65432;
+	my $sockdir = tempdir('bench_sock_XXXX', TMPDIR => 1, CLEANUP => 1);
+
+	rmtree($dir);
+	mkpath($dir);
+	$datadir = "$dir/data";
+
+	system_or_die('initdb', '-D', $datadir, '-A', 'trust', '-N',
+		'--no-locale');
+
+	open my $conf, '>>', "$datadir/postgresql.conf"
+	  or die "could not open postgresql.conf: $!\n";
+	print $conf "\n# Added by run_bench.pl\n";
+	print $conf "port = $port\n";
+	if ($^O eq 'MSWin32' || $^O eq 'msys')
+	{
+		print $conf "listen_addresses = '127.0.0.1'\n";
+		$ENV{PGHOST} = '127.0.0.1';
+	}
+	else
+	{
+		print $conf "listen_addresses = ''\n";
+		print $conf "unix_socket_directories = '$sockdir'\n";
+		$ENV{PGHOST} = $sockdir;
+	}
+	print $conf "shared_preload_libraries = 'bench_hotpath'\n";
+	print $conf "max_connections = " . ($opt{clients} + 10) . "\n";
+	foreach my $setting (@{ $opt{set} })
+	{
+		my ($name, $value) = split /=/, $setting, 2;
+		die "invalid setting \"$setting\"\n" unless defined $value;
+		print $conf "$name = '$value'\n";
+	}
+	close $conf;
+
+	system_or_die('pg_ctl', '-D', $datadir, '-l', "$dir/postmaster.log",
+		'-w', 'start');
+
+	$ENV{PGPORT} = $port;
+	$ENV{PGDATABASE} = 'postgres';
+	system_or_die('psql', '-X', '-q', '-c', 'CREATE DATABASE bench');
+	$ENV{PGDATABASE} = 'bench';
+}
+
+sub system_or_die
+{
+	system(@_) == 0 or die "command failed: @_\n";
+}
+
+# Run a command and return its standard output
+sub run_capture
+{
+	my @cmd = @_;
+
+	open my $fh, '-|', @cmd or die "could not run \"@cmd\": $!\n";
+	local $/;
+	my $out = <$fh>;
+	close $fh or die "command failed: @cmd\n";
+	return defined $out ? $out : '';
+}
+
+sub psql_do
+{
+	system_or_die('psql', '-X', '-q', '-v', 'ON_ERROR_STOP=1', '-c', $_[0]);
+}
+
+# Run a query and return its result, which must be a single value
+sub psql_query
+{
+	my $out = run_capture('psql', '-X', '-A', '-t', '-q', '-v',
+		'ON_ERROR_STOP=1', '-c', $_[0]);
+	chomp $out;
+	return $out;
+}
+
+sub psql_file
+{
+	my ($file, %vars) = @_;
+
+	system_or_die('psql', '-X', '-q', '-v', 'ON_ERROR_STOP=1',
+		(map { ('-v', "$_=$vars{$_}") } keys %vars), '-f', $file);
+}
+
+# Run SQL and return the server's execution time of its last statement, in
+# milliseconds, as measured by psql's \timing
+sub psql_timed
+{
+	my $sql = shift;
+	my $script = "$tmpdir/timed.sql";
+
+	open my $fh, '>', $script or die "could not open \"$script\": $!\n";
+	print $fh "\\timing on\n\\o $devnull\n$sql\n";
+	close $fh;
+
+	my $out = run_capture('psql', '-X', '-q', '-v', 'ON_ERROR_STOP=1',
+		'-f', $script);
+	my @times = $out =~ /^Time: ([\d.]+) ms/mg;
+	die "no timing in psql output:\n$out\n" unless @times;
+	return $times[-1];
+}
+
+# Run pgbench for --duration seconds and return its tps
+sub pgbench
+{
+	my $out = run_capture('pgbench', @_, '-c', $opt{clients},
+		'-j', $opt{jobs}, '-T', $opt{duration});
+	$out =~ /^tps = ([\d.]+) \(excluding connections establishing\)/m
+	  or die "could not parse pgbench output:\n$out\n";
+	return $1;
+}
+
+sub slurp
+{
+	my $file = shift;
+
+	open my $fh, '<', $file or die "could not open \"$file\": $!\n";
+	local $/;
+	my $contents = <$fh>;
+	close $fh;
+	return $contents;
+}
+
+sub median
+{
+	my @sorted = sort { $a <=> $b } @_;
+	my $n = scalar @sorted;
+
+	return $n % 2 ? $sorted[$n / 2] : ($sorted[$n / 2 - 1] + $sorted[$n / 2]) / 2;
+}
+
+sub emit_result
+{
+	my ($suite, $name, $value, $unit) = @_;
+
+	emit(sprintf("%s\t%s\t%.3f\t%s", $suite, $name, $value, $unit));
+}
+
+sub emit
+{
+	my $line = shift;
+
+	print "$line\n";
+	print $outfh "$line\n" if defined $outfh;
+}
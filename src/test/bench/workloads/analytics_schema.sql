@@ -0,0 +1,142 @@
+--
+-- Schema and data for the analytics workload.
+--
+-- This is modeled after the TPC-H schema, with fewer columns and with data
+-- generated by simple deterministic formulas rather than dbgen, so that the
+-- results are reproducible.  It is not a TPC-H implementation.  The psql
+-- variable "scale" sets the size; at scale 1, lineitem has about 600000
+-- rows.
+--
+
+DROP TABLE IF EXISTS lineitem, orders, customer, part, supplier, nation, region;
+
+CREATE TABLE region (
+	r_regionkey int PRIMARY KEY,
+	r_name text NOT NULL
+);
+
+CREATE TABLE nation (
+	n_nationkey int PRIMARY KEY,
+	n_name text NOT NULL,
+	n_regionkey int NOT NULL
+);
+
+CREATE TABLE supplier (
+	s_suppkey int PRIMARY KEY,
+	s_name text NOT NULL,
+	s_nationkey int NOT NULL,
+	s_acctbal numeric(12,2) NOT NULL
+);
+
+CREATE TABLE customer (
+	c_custkey int PRIMARY KEY,
+	c_name text NOT NULL,
+	c_nationkey int NOT NULL,
+	c_acctbal numeric(12,2) NOT NULL,
+	c_mktsegment text NOT NULL
+);
+
+CREATE TABLE part (
+	p_partkey int PRIMARY KEY,
+	p_name text NOT NULL,
+	p_brand text NOT NULL,
+	p_type text NOT NULL,
+	p_size int NOT NULL,
+	p_retailprice numeric(12,2) NOT NULL
+);
+
+CREATE TABLE orders (
+	o_orderkey int PRIMARY KEY,
+	o_custkey int NOT NULL,
+	o_orderstatus char(1) NOT NULL,
+	o_totalprice numeric(12,2) NOT NULL,
+	o_orderdate date NOT NULL,
+	o_orderpriority text NOT NULL
+);
+
+CREATE TABLE lineitem (
+	l_orderkey int NOT NULL,
+	l_linenumber int NOT NULL,
+	l_partkey int NOT NULL,
+	l_suppkey int NOT NULL,
+	l_quantity numeric(12,2) NOT NULL,
+	l_extendedprice numeric(12,2) NOT NULL,
+	l_discount numeric(12,2) NOT NULL,
+	l_tax numeric(12,2) NOT NULL,
+	l_returnflag char(1) NOT NULL,
+	l_linestatus char(1) NOT NULL,
+	l_shipdate date NOT NULL,
+	l_commitdate date NOT NULL,
+	l_receiptdate date NOT NULL,
+	l_shipmode text NOT NULL,
+	PRIMARY KEY (l_orderkey, l_linenumber)
+);
+
+INSERT INTO region VALUES
+	(0, 'AFRICA'), (1, 'AMERICA'), (2, 'ASIA'), (3, 'EUROPE'),
+	(4, 'MIDDLE EAST');
+
+INSERT INTO nation VALUES
+	(0, 'ALGERIA', 0), (1, 'ARGENTINA', 1), (2, 'BRAZIL', 1),
+	(3, 'CANADA', 1), (4, 'EGYPT', 4), (5, 'ETHIOPIA', 0),
+	(6, 'FRANCE', 3), (7, 'GERMANY', 3), (8, 'INDIA', 2),
+	(9, 'INDONESIA', 2), (10, 'IRAN', 4), (11, 'IRAQ', 4),
+	(12, 'JAPAN', 2), (13, 'JORDAN', 4), (14, 'KENYA', 0),
+	(15, 'MOROCCO', 0), (16, 'MOZAMBIQUE', 0), (17, 'PERU', 1),
+	(18, 'CHINA', 2), (19, 'ROMANIA', 3), (20, 'SAUDI ARABIA', 4),
+	(21, 'VIETNAM', 2), (22, 'RUSSIA', 3), (23, 'UNITED KINGDOM', 3),
+	(24, 'UNITED STATES', 1);
+
+INSERT INTO supplier
+	SELECT g, 'Supplier#' || g, g % 25, (g * 37 % 11000) - 1000
+	FROM generate_series(1, 1000 * :scale) g;
+
+INSERT INTO customer
+	SELECT g, 'Customer#' || g, (g * 7) % 25, (g * 53 % 11000) - 1000,
+		(ARRAY['AUTOMOBILE', 'BUILDING', 'FURNITURE', 'HOUSEHOLD',
+			   'MACHINERY'])[1 + g % 5]
+	FROM generate_series(1, 15000 * :scale) g;
+
+INSERT INTO part
+	SELECT g, 'part ' || g,
+		'Brand#' || (1 + g % 5) || (1 + g / 5 % 5),
+		(ARRAY['STANDARD', 'SMALL', 'MEDIUM', 'LARGE', 'ECONOMY',
+			   'PROMO'])[1 + g % 6] || ' ' ||
+		(ARRAY['ANODIZED', 'BURNISHED', 'PLATED', 'POLISHED',
+			   'BRUSHED'])[1 + g / 6 % 5] || ' ' ||
+		(ARRAY['TIN', 'NICKEL', 'BRASS', 'STEEL', 'COPPER'])[1 + g / 30 % 5],
+		1 + g % 50, 900 + g % 200 + (g % 100) / 100.0
+	FROM generate_series(1, 20000 * :scale) g;
+
+INSERT INTO orders
+	SELECT g, 1 + (g * 7) % (15000 * :scale),
+		CASE WHEN d < date '1995-06-17' THEN 'F' ELSE 'O' END,
+		(g * 13 % 50000) * 10.5, d,
+		(ARRAY['1-URGENT', '2-HIGH', '3-MEDIUM', '4-NOT SPECIFIED',
+			   '5-LOW'])[1 + g % 5]
+	FROM (SELECT g, date '1992-01-01' + (g * 13 % 2405) AS d
+		  FROM generate_series(1, 150000 * :scale) g) s;
+
+INSERT INTO lineitem
+	SELECT o_orderkey, ln, partkey, 1 + (o_orderkey * 3 + ln * 11) % (1000 * :scale),
+		qty, qty * (900 + partkey % 200), ((o_orderkey + ln) % 11) / 100.0,
+		((o_orderkey + ln * 3) % 9) / 100.0,
+		CASE WHEN receiptdate <= date '1995-06-17'
+			THEN (CASE (o_orderkey + ln) % 2 WHEN 0 THEN 'R' ELSE 'A' END)
+			ELSE 'N' END,
+		CASE WHEN shipdate > date '1995-06-17' THEN 'O' ELSE 'F' END,
+		shipdate, commitdate, receiptdate,
+		(ARRAY['REG AIR', 'AIR', 'RAIL', 'SHIP', 'TRUCK', 'MAIL',
+			   'FOB'])[1 + (o_orderkey + ln) % 7]
+	FROM (SELECT o_orderkey, ln,
+			1 + (o_orderkey * 7 + ln * 13) % (20000 * :scale) AS partkey,
+			1 + (o_orderkey + ln) % 50 AS qty,
+			o_orderdate + 1 + (o_orderkey + ln) % 121 AS shipdate,
+			o_orderdate + 30 + (o_orderkey * ln) % 61 AS commitdate,
+			o_orderdate + 2 + (o_orderkey + ln) % 121 + (o_orderkey + ln) % 30
+				AS receiptdate
+		  FROM orders, generate_series(1, 1 + o_orderkey % 7) ln) s;
+
+CREATE INDEX orders_custkey_idx ON orders (o_custkey);
+
+VACUUM ANALYZE;
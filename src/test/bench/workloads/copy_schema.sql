@@ -0,0 +1,20 @@
+--
+-- Tables for the bulk load workload.  copy_source is dumped to a file with
+-- \copy, which is then loaded into copy_plain, which has no indexes, and
+-- copy_indexed, which has two.  The psql variable "scale" sets the size;
+-- at scale 1, copy_source has 1000000 rows.
+--
+
+DROP TABLE IF EXISTS copy_source, copy_plain, copy_indexed;
+
+CREATE TABLE copy_source AS
+	SELECT g::int8 AS id, (g % 1000)::int4 AS grp, md5(g::text) AS payload,
+		timestamptz '2015-01-01' + g * interval '1 second' AS ts,
+		(g / 7.0)::numeric(12,2) AS amount
+	FROM generate_series(1, 1000000 * :scale) g;
+
+CREATE TABLE copy_plain (LIKE copy_source);
+
+CREATE TABLE copy_indexed (LIKE copy_source);
+CREATE INDEX copy_indexed_id_idx ON copy_indexed (id);
+CREATE INDEX copy_indexed_payload_idx ON copy_indexed (payload);
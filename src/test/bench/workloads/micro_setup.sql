@@ -0,0 +1,23 @@
+--
+-- Tables used by the micro-benchmarks that need one.  bench_narrow is small
+-- enough to stay in shared buffers; bench_wide has enough columns, of mixed
+-- widths and some NULL, to make deforming expensive.
+--
+
+CREATE EXTENSION IF NOT EXISTS bench_hotpath;
+
+DROP TABLE IF EXISTS bench_narrow, bench_wide;
+
+CREATE TABLE bench_narrow AS
+	SELECT g AS id, g % 100 AS val FROM generate_series(1, 100000) g;
+
+CREATE TABLE bench_wide AS
+	SELECT g AS c1, g::int8 AS c2, 'text ' || g AS c3, g / 3.0 AS c4,
+		CASE WHEN g % 3 = 0 THEN NULL ELSE g END AS c5,
+		now() AS c6, g % 2 = 0 AS c7, md5(g::text) AS c8,
+		g::float8 AS c9, g::int2 AS c10,
+		CASE WHEN g % 5 = 0 THEN NULL ELSE 'x' END AS c11,
+		g AS c12, g AS c13, g AS c14, g AS c15, g AS c16
+	FROM generate_series(1, 10000) g;
+
+VACUUM ANALYZE bench_narrow, bench_wide;
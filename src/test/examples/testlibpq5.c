@@ -0,0 +1,235 @@
+/*
+ * src/test/examples/testlibpq5.c
+ *
+ *
+ * testlibpq5.c
+ *		Test pipeline mode: several commands sent before any results are
+ *		read, sync points, and the skipping of commands after an error.
+ *
+ * No tables are needed; run it against any database.  Each result is
+ * checked against what pipeline mode promises, and the program exits with
+ * status 1 at the first surprise.  The expected output is:
+ *
+ * PGRES_TUPLES_OK "2"
+ * PGRES_FATAL_ERROR 22012
+ * PGRES_PIPELINE_ABORTED
+ * PGRES_PIPELINE_SYNC
+ * PGRES_TUPLES_OK "after sync"
+ * PGRES_PIPELINE_SYNC
+ * PGRES_TUPLES_OK "out of pipeline"
+ */
+
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libpq-fe.h"
+
+
+static void
+exit_nicely(PGconn *conn)
+{
+	PQfinish(conn);
+	exit(1);
+}
+
+/*
+ * Send a single-column query with the extended protocol, as pipeline mode
+ * requires.
+ */
+static void
+send_query(PGconn *conn, const char *query)
+{
+	if (!PQsendQueryParams(conn, query, 0, NULL, NULL, NULL, NULL, 0))
+	{
+		fprintf(stderr, "sending \"%s\" failed: %s",
+				query, PQerrorMessage(conn));
+		exit_nicely(conn);
+	}
+}
+
+/*
+ * Fetch the next result and check its status and, if value isn't NULL,
+ * that it holds that single value.  For an error, report its SQLSTATE.
+ */
+static void
+check_result(PGconn *conn, ExecStatusType expected, const char *value)
+{
+	PGresult   *res = PQgetResult(conn);
+
+	if (res == NULL)
+	{
+		fprintf(stderr, "expected %s, got no result\n",
+				PQresStatus(expected));
+		exit_nicely(conn);
+	}
+	if (PQresultStatus(res) != expected)
+	{
+		fprintf(stderr, "expected %s, got %s: %s",
+				PQresStatus(expected), PQresStatus(PQresultStatus(res)),
+				PQerrorMessage(conn));
+		PQclear(res);
+		exit_nicely(conn);
+	}
+	if (value != NULL &&
+		(PQntuples(res) != 1 || strcmp(PQgetvalue(res, 0, 0), value) != 0))
+	{
+		fprintf(stderr, "expected \"%s\", got %d rows\n",
+				value, PQntuples(res));
+		PQclear(res);
+		exit_nicely(conn);
+	}
+
+	printf("%s", PQresStatus(expected));
+	if (value != NULL)
+		printf(" \"%s\"", value);
+	if (expected == PGRES_FATAL_ERROR)
+		printf(" %s", PQresultErrorField(res, PG_DIAG_SQLSTATE));
+	printf("\n");
+
+	PQclear(res);
+}
+
+/*
+ * Check that the results of a command are over.
+ */
+static void
+check_end(PGconn *conn)
+{
+	PGresult   *res = PQgetResult(conn);
+
+	if (res != NULL)
+	{
+		fprintf(stderr, "expected end of results, got %s\n",
+				PQresStatus(PQresultStatus(res)));
+		PQclear(res);
+		exit_nicely(conn);
+	}
+}
+
+static void
+check_status(PGconn *conn, PGpipelineStatus expected)
+{
+	if (PQpipelineStatus(conn) != expected)
+	{
+		fprintf(stderr, "unexpected pipeline status %d, expected %d\n",
+				(int) PQpipelineStatus(conn), (int) expected);
+		exit_nicely(conn);
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *conninfo;
+	PGconn	   *conn;
+	PGresult   *res;
+
+	/*
+	 * If the user supplies a parameter on the command line, use it as the
+	 * conninfo string; otherwise default to setting dbname=postgres and using
+	 * environment variables or defaults for all other connection parameters.
+	 */
+	if (argc > 1)
+		conninfo = argv[1];
+	else
+		conninfo = "dbname = postgres";
+
+	/* Make a connection to the database */
+	conn = PQconnectdb(conninfo);
+
+	/* Check to see that the backend connection was successfully made */
+	if (PQstatus(conn) != CONNECTION_OK)
+	{
+		fprintf(stderr, "Connection to database failed: %s",
+				PQerrorMessage(conn));
+		exit_nicely(conn);
+	}
+
+	if (!PQenterPipelineMode(conn))
+	{
+		fprintf(stderr, "could not enter pipeline mode: %s",
+				PQerrorMessage(conn));
+		exit_nicely(conn);
+	}
+	check_status(conn, PQ_PIPELINE_ON);
+
+	/* The simple query protocol and synchronous functions are refused */
+	if (PQsendQuery(conn, "SELECT 1"))
+	{
+		fprintf(stderr, "PQsendQuery was allowed in pipeline mode\n");
+		exit_nicely(conn);
+	}
+	res = PQexec(conn, "SELECT 1");
+	if (res != NULL)
+	{
+		fprintf(stderr, "PQexec was allowed in pipeline mode\n");
+		PQclear(res);
+		exit_nicely(conn);
+	}
+
+	/*
+	 * Send two groups of commands before reading anything.  The error in the
+	 * first group makes the server skip the rest of it, but not the second
+	 * group.
+	 */
+	send_query(conn, "SELECT 1 + 1");
+	send_query(conn, "SELECT 1 / 0");
+	send_query(conn, "SELECT 'skipped'");
+	if (!PQpipelineSync(conn))
+	{
+		fprintf(stderr, "PQpipelineSync failed: %s", PQerrorMessage(conn));
+		exit_nicely(conn);
+	}
+	send_query(conn, "SELECT 'after sync'");
+	if (!PQpipelineSync(conn))
+	{
+		fprintf(stderr, "PQpipelineSync failed: %s", PQerrorMessage(conn));
+		exit_nicely(conn);
+	}
+
+	/* The results of each command are followed by a NULL ... */
+	check_result(conn, PGRES_TUPLES_OK, "2");
+	check_end(conn);
+	check_result(conn, PGRES_FATAL_ERROR, NULL);
+	check_status(conn, PQ_PIPELINE_ABORTED);
+	check_end(conn);
+	check_result(conn, PGRES_PIPELINE_ABORTED, NULL);
+	check_end(conn);
+
+	/* ... but nothing separates a sync point from what follows it */
+	check_result(conn, PGRES_PIPELINE_SYNC, NULL);
+	check_status(conn, PQ_PIPELINE_ON);
+	check_result(conn, PGRES_TUPLES_OK, "after sync");
+	check_end(conn);
+	check_result(conn, PGRES_PIPELINE_SYNC, NULL);
+	check_end(conn);
+
+	if (!PQexitPipelineMode(conn))
+	{
+		fprintf(stderr, "could not exit pipeline mode: %s",
+				PQerrorMessage(conn));
+		exit_nicely(conn);
+	}
+	check_status(conn, PQ_PIPELINE_OFF);
+
+	/* Back in normal mode, synchronous functions work again */
+	res = PQexec(conn, "SELECT 'out of pipeline'");
+	if (PQresultStatus(res) != PGRES_TUPLES_OK)
+	{
+		fprintf(stderr, "SELECT failed: %s", PQerrorMessage(conn));
+		PQclear(res);
+		exit_nicely(conn);
+	}
+	printf("%s \"%s\"\n", PQresStatus(PQresultStatus(res)),
+		   PQgetvalue(res, 0, 0));
+	PQclear(res);
+
+	/* close the connection to the database and cleanup */
+	PQfinish(conn);
+
+	return 0;
+}
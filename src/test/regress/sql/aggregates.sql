@@ -590,3 +590,29 @@ drop view aggordview1;
 -- variadic aggregates
 select least_agg(q1,q2) from int8_tbl;
 select least_agg(variadic array[q1,q2]) from int8_tbl;
+
+-- hashed aggregation spilling to disk
+create function hashagg_batches_used(query text) returns bool
+language plpgsql as $$
+declare
+  ln text;
+begin
+  for ln in execute 'explain (analyze, costs off, timing off) ' || query loop
+    if ln ~ '^ *Batches: [0-9]+' then
+      return true;
+    end if;
+  end loop;
+  return false;
+end$$;
+set work_mem = '64kB';
+explain (costs off)
+select g % 10000 as k, count(*), sum(g)
+  from generate_series(1, 40000) g group by 1;
+select hashagg_batches_used('select g % 10000 as k, count(*), sum(g)
+  from generate_series(1, 40000) g group by 1');
+-- every group must be returned once, with all of its rows
+select count(*), count(distinct k), sum(cnt), sum(s), min(cnt), max(cnt)
+  from (select g % 10000 as k, count(*) as cnt, sum(g) as s
+          from generate_series(1, 40000) g group by 1) ss;
+reset work_mem;
+drop function hashagg_batches_used(text);
@@ -291,6 +291,11 @@ select 33 = all (null::int[]);
 select null::int = all ('{1,2,3}');
 select 33 = all ('{1,null,3}');
 select 33 = all ('{33,null,33}');
+-- large constant arrays are searched by hashing
+select count(*) from generate_series(1, 20) g
+  where g in (2, 3, 5, 7, 11, 13, 17, 19, 23, 29);
+select g, g = any ('{1,2,3,4,5,6,7,8,9,null}') from generate_series(9, 11) g;
+select s, s = any ('{a,b,c,d,e,f,g,h,i,j,j}') from (values ('e'), ('z'), (null)) v(s);
 
 -- test indexes on arrays
 create temp table arr_tbl (f1 int[] unique);
@@ -17,3 +17,16 @@ NOTIFY notify_async2;
 LISTEN notify_async2;
 UNLISTEN notify_async2;
 UNLISTEN *;
+
+-- Should work. Enough notifications in one transaction, some of them
+-- duplicates, to have them hashed, also across a subtransaction
+BEGIN;
+SELECT count(pg_notify('notify_async3', (i % 20)::text))
+  FROM generate_series(1, 100) i;
+SAVEPOINT s1;
+SELECT count(pg_notify('notify_async3', (i % 30)::text))
+  FROM generate_series(1, 100) i;
+RELEASE SAVEPOINT s1;
+SELECT count(pg_notify('notify_async3', (i % 40)::text))
+  FROM generate_series(1, 100) i;
+COMMIT;
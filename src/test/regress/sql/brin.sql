@@ -416,3 +416,89 @@ VACUUM brintest;  -- force a summarization cycle in brinidx
 
 UPDATE brintest SET int8col = int8col * int4col;
 UPDATE brintest SET textcol = '' WHERE textcol IS NOT NULL;
+
+-- bloom and multi-range minmax opclasses
+CREATE TABLE brin_opc (i4 int, i8 bigint, t text, ts timestamp,
+	f8 float8, d date) WITH (fillfactor = 10);
+INSERT INTO brin_opc SELECT
+	(g * 37) % 1000,
+	CASE WHEN g % 100 = 0 THEN g * 1000 ELSE g END,	-- some outliers
+	'val' || ((g * 13) % 500),
+	timestamp '2015-01-01' + ((g * 7) % 300) * interval '1 hour',
+	CASE WHEN g % 50 = 0 THEN -g ELSE g / 10.0 END,
+	date '2015-01-01' + g
+FROM generate_series(1, 1500) g;
+INSERT INTO brin_opc SELECT NULL, NULL, NULL, NULL, NULL, NULL
+FROM generate_series(1, 10);
+CREATE INDEX brin_bloom_idx ON brin_opc USING brin (i4 int4_bloom_ops,
+	t text_bloom_ops, ts timestamp_bloom_ops) WITH (pages_per_range = 2);
+CREATE INDEX brin_multi_idx ON brin_opc USING brin (i8 int8_minmax_multi_ops,
+	f8 float8_minmax_multi_ops, d date_minmax_multi_ops)
+	WITH (pages_per_range = 2);
+INSERT INTO brin_opc SELECT
+	(g * 37) % 1000,
+	CASE WHEN g % 100 = 0 THEN g * 1000 ELSE g END,	-- some outliers
+	'val' || ((g * 13) % 500),
+	timestamp '2015-01-01' + ((g * 7) % 300) * interval '1 hour',
+	CASE WHEN g % 50 = 0 THEN -g ELSE g / 10.0 END,
+	date '2015-01-01' + g
+FROM generate_series(1501, 2000) g;
+VACUUM brin_opc;  -- summarize the new ranges
+SET enable_seqscan = off;
+EXPLAIN (COSTS OFF)
+SELECT count(*) FROM brin_opc WHERE i4 = 37;
+SELECT count(*) FROM brin_opc WHERE i4 = 37;
+SELECT count(*) FROM brin_opc WHERE i4 = 1000;
+SELECT count(*) FROM brin_opc WHERE t = 'val13';
+SELECT count(*) FROM brin_opc WHERE ts = '2015-01-02 00:00';
+SELECT count(*) FROM brin_opc WHERE t IS NULL;
+EXPLAIN (COSTS OFF)
+SELECT count(*) FROM brin_opc WHERE i8 = 100000::bigint;
+SELECT count(*) FROM brin_opc WHERE i8 = 100000::bigint;
+SELECT count(*) FROM brin_opc WHERE i8 BETWEEN 150::bigint AND 160::bigint;
+SELECT count(*) FROM brin_opc WHERE i8 > 1500000::bigint;
+SELECT count(*) FROM brin_opc WHERE f8 < 0;
+SELECT count(*) FROM brin_opc WHERE f8 >= 199.5;
+SELECT count(*) FROM brin_opc WHERE d = '2015-03-01';
+SELECT count(*) FROM brin_opc WHERE d IS NOT NULL;
+RESET enable_seqscan;
+DROP TABLE brin_opc;
+
+-- brin_summarize_range
+CREATE TABLE brin_summarize (value int)
+	WITH (fillfactor = 10, autovacuum_enabled = false);
+CREATE INDEX brin_summarize_idx ON brin_summarize USING brin (value)
+	WITH (pages_per_range = 2);
+-- fill three pages
+DO $$
+DECLARE curtid tid;
+BEGIN
+	LOOP
+		INSERT INTO brin_summarize VALUES (1) RETURNING ctid INTO curtid;
+		EXIT WHEN curtid > tid '(2, 0)';
+	END LOOP;
+END;
+$$;
+SELECT brin_summarize_range('brin_summarize_idx', 0);	-- done by CREATE INDEX
+SELECT brin_summarize_range('brin_summarize_idx', 1);	-- same range
+SELECT brin_summarize_range('brin_summarize_idx', 2);
+SELECT brin_summarize_range('brin_summarize_idx', 4294967);	-- past the end
+SELECT brin_summarize_range('brin_summarize_idx', -1);
+SELECT brin_summarize_range('brin_summarize_idx', 4294967296);
+SELECT brin_summarize_range('tenk1_unique1', 0);
+DROP TABLE brin_summarize;
+
+-- autosummarize
+CREATE TABLE brin_autosum (value int) WITH (fillfactor = 10);
+CREATE INDEX brin_autosum_idx ON brin_autosum USING brin (value)
+	WITH (pages_per_range = 1, autosummarize = on);
+INSERT INTO brin_autosum SELECT g FROM generate_series(1, 200) g;
+SELECT reloptions FROM pg_class WHERE oid = 'brin_autosum_idx'::regclass;
+SET enable_seqscan = off;
+SELECT count(*) FROM brin_autosum WHERE value = 150;
+RESET enable_seqscan;
+ALTER INDEX brin_autosum_idx SET (autosummarize = off);
+SELECT reloptions FROM pg_class WHERE oid = 'brin_autosum_idx'::regclass;
+CREATE INDEX ON brin_autosum USING brin (value)
+	WITH (autosummarize = 'maybe');
+DROP TABLE brin_autosum;
@@ -0,0 +1,85 @@
+--
+-- TOAST compression methods
+--
+CREATE TABLE cmdata (f1 text);
+
+-- pglz is the default method
+SHOW default_toast_compression;
+INSERT INTO cmdata VALUES (repeat('1234567890', 1000));
+INSERT INTO cmdata SELECT string_agg(i::text || repeat('x', 50), '')
+  FROM generate_series(1, 1000) i;
+SELECT pg_column_compression(f1), length(f1), pg_column_size(f1) < length(f1)
+  FROM cmdata ORDER BY length(f1);
+
+-- values that aren't compressed
+INSERT INTO cmdata VALUES ('short');
+SELECT pg_column_compression(f1) FROM cmdata WHERE f1 = 'short';
+SELECT pg_column_compression(1), pg_column_compression('abc'::text);
+
+-- the method of a column is kept as an attribute option
+ALTER TABLE cmdata ALTER COLUMN f1 SET COMPRESSION pglz;
+SELECT attoptions FROM pg_attribute
+  WHERE attrelid = 'cmdata'::regclass AND attname = 'f1';
+ALTER TABLE cmdata ALTER COLUMN f1 SET COMPRESSION nosuch;  -- ERROR
+ALTER TABLE cmdata ALTER COLUMN f1 SET (compression = nosuch);  -- ERROR
+ALTER TABLE cmdata ALTER COLUMN f1 RESET (compression);
+SELECT attoptions FROM pg_attribute
+  WHERE attrelid = 'cmdata'::regclass AND attname = 'f1';
+
+-- values round-trip with every method this server supports, whether it's
+-- chosen by the column or by default_toast_compression
+CREATE TABLE cmdata2 (f1 text);
+DO $$
+DECLARE
+  m text;
+  v text := repeat('abcdefghij', 5000);
+BEGIN
+  FOR m IN SELECT unnest(enumvals) FROM pg_settings
+           WHERE name = 'default_toast_compression'
+  LOOP
+    EXECUTE format('ALTER TABLE cmdata ALTER COLUMN f1 SET COMPRESSION %s', m);
+    INSERT INTO cmdata VALUES (m || v);
+    IF (SELECT pg_column_compression(f1) FROM cmdata WHERE f1 = m || v)
+       IS DISTINCT FROM m THEN
+      RAISE EXCEPTION 'column value not compressed with %', m;
+    END IF;
+
+    PERFORM set_config('default_toast_compression', m, true);
+    INSERT INTO cmdata2 VALUES (m || v);
+    IF (SELECT pg_column_compression(f1) FROM cmdata2 WHERE f1 = m || v)
+       IS DISTINCT FROM m THEN
+      RAISE EXCEPTION 'default value not compressed with %', m;
+    END IF;
+  END LOOP;
+END $$;
+SHOW default_toast_compression;
+SELECT bool_and(right(f1, 10) = 'abcdefghij') FROM cmdata
+  WHERE length(f1) BETWEEN 50001 AND 50010;
+SELECT bool_and(right(f1, 10) = 'abcdefghij') FROM cmdata2;
+
+-- slices, LIKE, position() and jsonb lookups decompress only what they need
+SELECT bool_and(substr(f1, length(pg_column_compression(f1)) + 1, 12) = 'abcdefghijab') AS substr,
+       bool_and(f1 LIKE pg_column_compression(f1) || 'abcdefghij%') AS "like",
+       bool_and(f1 NOT LIKE pg_column_compression(f1) || 'abcdefghik%') AS notlike,
+       bool_and(position('cdef' in f1) = length(pg_column_compression(f1)) + 3) AS pos
+  FROM cmdata WHERE length(f1) BETWEEN 50001 AND 50010;
+CREATE TABLE cmdata3 AS
+  SELECT string_agg(repeat(md5(i::text), 2), '') AS f1,
+         jsonb_object_agg('k' || i, repeat(md5(i::text), 10)) AS f2
+  FROM generate_series(1, 2000) i;
+ALTER TABLE cmdata3 ALTER COLUMN f1 SET STORAGE EXTERNAL,
+  ALTER COLUMN f2 SET STORAGE EXTERNAL;
+INSERT INTO cmdata3 SELECT f1 || '', f2 || '{}' FROM cmdata3;
+SELECT pg_column_compression(f1) AS method, substr(f1, 1, 8),
+       f1 LIKE 'c4ca4238%' AS "like", f1 LIKE 'c4ca4239%' AS nolike,
+       position('c81e728d' in f1) AS pos1,
+       position('08f90c1a417155361a5c4b8d297e0d78' in f1) AS pos2,
+       position('nosuch' in f1) AS nopos
+  FROM cmdata3 ORDER BY 1;
+SELECT pg_column_compression(f2) AS method,
+       f2->>'k1' = repeat(md5('1'), 10) AS k1,
+       f2->'k2000' = to_jsonb(repeat(md5('2000'), 10)) AS k2000,
+       f2->'nosuch' IS NULL AS nosuch
+  FROM cmdata3 ORDER BY 1;
+
+DROP TABLE cmdata, cmdata2, cmdata3;
@@ -144,3 +144,25 @@ CREATE AGGREGATE wrongreturntype (float8)
     msfunc = float8pl,
     minvfunc = float8mi_int
 );
+
+-- combine function
+CREATE AGGREGATE mysum (int)
+(
+    stype = int,
+    sfunc = int4pl,
+    combinefunc = int4pl
+);
+
+SELECT aggfnoid, aggtransfn, aggcombinefn, aggtranstype
+FROM pg_aggregate
+WHERE aggfnoid = 'mysum'::REGPROC;
+
+DROP AGGREGATE mysum (int);
+
+-- invalid: combine function must accept two transition values
+CREATE AGGREGATE wrongcombine (int)
+(
+    stype = int,
+    sfunc = int4pl,
+    combinefunc = int4_avg_combine
+);
@@ -820,6 +820,31 @@ DROP INDEX cwi_replaced_pkey;	-- Should fail; a constraint depends on it
 
 DROP TABLE cwi_test;
 
+--
+-- Non-key INCLUDE columns
+--
+CREATE TABLE cov (a int, b int, c text);
+INSERT INTO cov SELECT g, g % 10, 'c' || g FROM generate_series(1, 100) g;
+CREATE UNIQUE INDEX cov_idx ON cov (a) INCLUDE (b);
+\d cov
+\d cov_idx
+SELECT pg_get_indexdef('cov_idx'::regclass);
+-- only the key columns take part in uniqueness
+INSERT INTO cov VALUES (1, 1, 'dup');	-- fail
+INSERT INTO cov VALUES (101, 1, 'ok');
+-- included columns can be returned by index-only scans
+VACUUM ANALYZE cov;
+SET enable_seqscan = off;
+SET enable_bitmapscan = off;
+EXPLAIN (COSTS OFF)
+SELECT a, b FROM cov WHERE a < 4 ORDER BY a;
+SELECT a, b FROM cov WHERE a < 4 ORDER BY a;
+RESET enable_seqscan;
+RESET enable_bitmapscan;
+CREATE INDEX ON cov USING hash (a) INCLUDE (b);	-- fail
+ALTER TABLE cov ADD PRIMARY KEY USING INDEX cov_idx;	-- fail
+DROP TABLE cov;
+
 --
 -- Tests for IS NULL/IS NOT NULL with b-tree indexes
 --
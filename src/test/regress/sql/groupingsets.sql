@@ -41,6 +41,10 @@ create function gstest_data(v integer, out a integer, out b integer)
     end;
   $f$ language plpgsql;
 
+-- these tests mostly don't use ORDER BY, so stick to sorted grouping to keep
+-- the output order stable
+set enable_hashagg = false;
+
 -- basic functionality
 
 -- simple rollup with multiple plain aggregates, with and without ordering
@@ -162,4 +166,6 @@ group by rollup(ten);
 select * from (values (1),(2)) v(a) left join lateral (select v.a, four, ten, count(*) from onek group by cube(four,ten)) s on true order by v.a,four,ten;
 select array(select row(v.a,s1.*) from (select two,four, count(*) from onek group by cube(two,four) order by two,four) s1) from (values (1),(2)) v(a);
 
+reset enable_hashagg;
+
 -- end
@@ -473,3 +473,80 @@ FROM generate_series(1, 3) g(i);
 reset enable_seqscan;
 reset enable_indexscan;
 reset enable_bitmapscan;
+
+--
+-- Run-time pruning of inheritance children once the values of Params are
+-- known.  Queries in SQL functions are always planned generically.
+--
+create table prune_parent (a int, b text);
+create table prune_c1 (check (a < 10)) inherits (prune_parent);
+create table prune_c2 (check (a >= 10 and a < 20)) inherits (prune_parent);
+create table prune_c3 (check (a >= 20)) inherits (prune_parent);
+insert into prune_c1 values (1, 'one'), (5, 'five');
+insert into prune_c2 values (10, 'ten'), (15, 'fifteen');
+insert into prune_c3 values (20, 'twenty'), (25, 'twenty-five');
+create function prune_count(int) returns bigint as
+  'select count(*) from prune_parent where a >= $1 and a < $1 + 10'
+  language sql stable;
+create function prune_min(int) returns text as
+  'select b from prune_parent where a >= $1 order by a limit 1'
+  language sql stable;
+select prune_count(0), prune_count(10), prune_count(15), prune_count(30);
+select prune_min(3), prune_min(12), prune_min(21), coalesce(prune_min(26), '-');
+drop function prune_count(int);
+drop function prune_min(int);
+drop table prune_parent cascade;
+
+--
+-- Grouping each inheritance child on its own, when the children's CHECK
+-- constraints keep the values of a GROUP BY column apart
+--
+create table pagg_parent (a int not null, b int, c text, check (false) no inherit);
+create table pagg_c1 (check (a >= 0 and a < 1000)) inherits (pagg_parent);
+create table pagg_c2 (check (a >= 1000 and a < 2000)) inherits (pagg_parent);
+create table pagg_c3 (check (a >= 2000 and a < 3000)) inherits (pagg_parent);
+insert into pagg_c1 select i % 200, i % 7, to_char(i % 5, 'FM0') from generate_series(0, 2999) i;
+insert into pagg_c2 select i % 200 + 1000, i % 7, to_char(i % 5, 'FM0') from generate_series(0, 2999) i;
+insert into pagg_c3 select i % 200 + 2000, i % 7, to_char(i % 5, 'FM0') from generate_series(0, 2999) i;
+analyze pagg_parent;
+analyze pagg_c1;
+analyze pagg_c2;
+analyze pagg_c3;
+set enable_partitionwise_aggregate = on;
+-- no single hash table fits in work_mem, but each child's does
+set work_mem = '64kB';
+explain (costs off)
+select a, count(*), sum(b) from pagg_parent group by a having avg(b) > 3;
+select count(*), sum(n), sum(s) from
+  (select a, count(*) n, sum(b) s from pagg_parent group by a having avg(b) > 3) ss;
+reset work_mem;
+-- sorting each child is cheaper than sorting them all
+set enable_hashagg = off;
+explain (costs off)
+select c, a, count(*) from pagg_parent group by c, a;
+select c, a, count(*) from pagg_parent group by c, a order by a desc, c limit 3;
+reset enable_hashagg;
+-- the same results without it
+set enable_partitionwise_aggregate = off;
+select count(*), sum(n), sum(s) from
+  (select a, count(*) n, sum(b) s from pagg_parent group by a having avg(b) > 3) ss;
+select c, a, count(*) from pagg_parent group by c, a order by a desc, c limit 3;
+set enable_partitionwise_aggregate = on;
+-- not possible: b isn't kept apart
+explain (costs off)
+select b, count(*) from pagg_parent group by b;
+-- not possible: the ranges overlap
+alter table pagg_c3 drop constraint pagg_c3_a_check;
+alter table pagg_c3 add check (a >= 1500 and a < 3000);
+set enable_hashagg = off;
+explain (costs off)
+select a, count(*) from pagg_parent group by a;
+-- not possible: a can be null
+alter table pagg_c3 drop constraint pagg_c3_a_check;
+alter table pagg_c3 add check (a >= 2000 and a < 3000);
+alter table pagg_c2 alter a drop not null;
+explain (costs off)
+select a, count(*) from pagg_parent group by a;
+reset enable_hashagg;
+reset enable_partitionwise_aggregate;
+drop table pagg_parent cascade;
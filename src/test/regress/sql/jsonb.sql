@@ -614,6 +614,10 @@ SELECT '["a","b"]'::jsonb @> '["a","b","c","b"]';
 SELECT '["a","b","c","b"]'::jsonb @> '["a","b"]';
 SELECT '["a","b","c",[1,2]]'::jsonb @> '["a",[1,2]]';
 SELECT '["a","b","c",[1,2]]'::jsonb @> '["b",[1,2]]';
+SELECT '[1, "1", null, true, 2.0, "ab", [1], {"a":1}, false, "b"]'::jsonb @> '[2, "1", null, false]';
+SELECT '[1, "1", null, true, 2.0, "ab", [1], {"a":1}, false, "b"]'::jsonb @> '["1", 1.5, true]';
+SELECT '[1, "1", null, true, 2.0, "ab", [1], {"a":1}, false, "b"]'::jsonb @> '["b", [1], {"a":1}, true]';
+SELECT '[1, "1", null, true, 2.0, "ab", [1], {"a":1}, false, "b"]'::jsonb @> '["b", [2], "ab", true]';
 
 SELECT '{"a":[1,2],"c":"b"}'::jsonb @> '{"a":[1]}';
 SELECT '{"a":[1,2],"c":"b"}'::jsonb @> '{"a":[2]}';
@@ -209,3 +209,53 @@ REFRESH MATERIALIZED VIEW mv_foo;
 REFRESH MATERIALIZED VIEW CONCURRENTLY mv_foo;
 DROP OWNED BY user_dw CASCADE;
 DROP ROLE user_dw;
+
+-- incrementally maintained materialized views
+CREATE TABLE ivm_a (id int PRIMARY KEY, grp text, val numeric);
+CREATE TABLE ivm_b (id int REFERENCES ivm_a ON DELETE CASCADE, tag text);
+INSERT INTO ivm_a VALUES (1, 'x', 10), (2, 'x', 20), (3, 'y', NULL);
+INSERT INTO ivm_b VALUES (1, 'one'), (2, 'two'), (2, 'deux');
+CREATE INCREMENTAL MATERIALIZED VIEW ivm_bad AS SELECT DISTINCT grp FROM ivm_a;
+CREATE INCREMENTAL MATERIALIZED VIEW ivm_bad AS
+  SELECT grp, max(val) FROM ivm_a GROUP BY grp;
+CREATE INCREMENTAL MATERIALIZED VIEW ivm_bad AS
+  SELECT a.id, b.tag FROM ivm_a a LEFT JOIN ivm_b b ON a.id = b.id;
+CREATE INCREMENTAL MATERIALIZED VIEW ivm_bad (__ivm_x) AS SELECT id FROM ivm_a;
+CREATE INCREMENTAL MATERIALIZED VIEW ivm_join AS
+  SELECT a.id, a.grp, b.tag FROM ivm_a a JOIN ivm_b b ON a.id = b.id;
+CREATE INCREMENTAL MATERIALIZED VIEW ivm_agg AS
+  SELECT grp, count(*) AS n, count(val) AS nval, sum(val) AS total,
+    avg(val) AS average
+  FROM ivm_a GROUP BY grp;
+CREATE INCREMENTAL MATERIALIZED VIEW ivm_total AS
+  SELECT count(*) AS n, sum(a.val) AS total
+  FROM ivm_a a JOIN ivm_b b ON a.id = b.id;
+SELECT count(*) FROM pg_trigger WHERE tgrelid = 'ivm_a'::regclass AND tgisinternal AND tgname LIKE 'IVM%';
+SELECT grp, __ivm_count__ FROM ivm_agg ORDER BY grp;
+INSERT INTO ivm_a VALUES (4, 'y', 5), (5, 'z', 7);
+INSERT INTO ivm_b VALUES (4, 'four'), (3, 'three');
+UPDATE ivm_a SET val = val + 1 WHERE grp = 'x';
+UPDATE ivm_a SET grp = 'z' WHERE id = 4;
+SELECT id, grp, tag FROM ivm_join ORDER BY id, tag;
+SELECT grp, n, nval, total, average FROM ivm_agg ORDER BY grp;
+SELECT n, total FROM ivm_total;
+-- deletes cascading to the other table count once
+DELETE FROM ivm_a WHERE id = 2;
+DELETE FROM ivm_a WHERE grp = 'y';
+SELECT id, grp, tag FROM ivm_join ORDER BY id, tag;
+SELECT grp, n, nval, total, average FROM ivm_agg ORDER BY grp;
+SELECT n, total FROM ivm_total;
+-- groups with a NULL key
+INSERT INTO ivm_a VALUES (6, NULL, 1);
+UPDATE ivm_a SET val = 3 WHERE id = 6;
+SELECT grp, n, nval, total, average FROM ivm_agg ORDER BY grp;
+-- TRUNCATE recomputes
+TRUNCATE ivm_b;
+SELECT id, grp, tag FROM ivm_join ORDER BY id, tag;
+SELECT n, total FROM ivm_total;
+INSERT INTO ivm_b VALUES (1, 'uno');
+SELECT id, grp, tag FROM ivm_join ORDER BY id, tag;
+SELECT n, total FROM ivm_total;
+DROP MATERIALIZED VIEW ivm_join, ivm_agg, ivm_total;
+SELECT count(*) FROM pg_trigger WHERE tgrelid = 'ivm_a'::regclass AND tgisinternal AND tgname LIKE 'IVM%';
+DROP TABLE ivm_b, ivm_a;
@@ -0,0 +1,96 @@
+--
+-- Memoize
+--
+
+-- Run EXPLAIN ANALYZE on a query, hiding the parts of its output that vary
+-- from run to run
+create function explain_memoize(query text, hide_hitmiss bool) returns setof text
+language plpgsql as
+$$
+declare
+    ln text;
+begin
+    for ln in
+        execute format('explain (analyze, costs off, timing off) %s',
+            query)
+    loop
+        if ln ~ '^(Planning|Execution) time:' then
+            continue;
+        end if;
+        if hide_hitmiss = true then
+            ln := regexp_replace(ln, 'Hits: 0', 'Hits: Zero');
+            ln := regexp_replace(ln, 'Hits: \d+', 'Hits: N');
+            ln := regexp_replace(ln, 'Misses: 0', 'Misses: Zero');
+            ln := regexp_replace(ln, 'Misses: \d+', 'Misses: N');
+        end if;
+        ln := regexp_replace(ln, 'Evictions: 0', 'Evictions: Zero');
+        ln := regexp_replace(ln, 'Evictions: \d+', 'Evictions: N');
+        ln := regexp_replace(ln, 'Memory Usage: \d+', 'Memory Usage: N');
+        ln := regexp_replace(ln, 'Heap Fetches: \d+', 'Heap Fetches: N');
+        ln := regexp_replace(ln, 'loops=\d+', 'loops=N');
+        return next ln;
+    end loop;
+end;
+$$;
+
+SET enable_hashjoin TO off;
+SET enable_mergejoin TO off;
+SET enable_bitmapscan TO off;
+
+-- Each of the 20 distinct join keys misses once, then always hits
+SELECT explain_memoize('
+SELECT COUNT(*), AVG(t1.unique1) FROM tenk1 t1
+INNER JOIN tenk1 t2 ON t1.unique1 = t2.twenty
+WHERE t2.unique1 < 1000;', false);
+
+SELECT COUNT(*), AVG(t1.unique1) FROM tenk1 t1
+INNER JOIN tenk1 t2 ON t1.unique1 = t2.twenty
+WHERE t2.unique1 < 1000;
+
+-- The same, as a semi join
+SELECT explain_memoize('
+SELECT COUNT(*) FROM tenk1 t1
+WHERE t1.unique1 < 1000 AND
+  EXISTS (SELECT 1 FROM tenk1 t2 WHERE t2.hundred = t1.twenty);', false);
+
+SELECT COUNT(*) FROM tenk1 t1
+WHERE t1.unique1 < 1000 AND
+  EXISTS (SELECT 1 FROM tenk1 t2 WHERE t2.hundred = t1.twenty);
+
+-- A parameter that isn't part of the cache key changes on each rescan of
+-- the subquery, which must throw the cache away
+SELECT explain_memoize('
+SELECT o.x, (SELECT COUNT(*) FROM tenk1 t1
+  INNER JOIN tenk1 t2 ON t2.unique1 = t1.twenty AND t2.hundred >= o.x
+  WHERE t1.unique1 < 100)
+FROM (VALUES (0), (10)) o(x);', false);
+
+SELECT o.x, (SELECT COUNT(*) FROM tenk1 t1
+  INNER JOIN tenk1 t2 ON t2.unique1 = t1.twenty AND t2.hundred >= o.x
+  WHERE t1.unique1 < 100)
+FROM (VALUES (0), (10)) o(x);
+
+-- With 1000 distinct keys, a small work_mem forces evictions
+SET work_mem TO '64kB';
+SELECT explain_memoize('
+SELECT COUNT(*), AVG(t1.unique1) FROM tenk1 t1
+INNER JOIN tenk1 t2 ON t1.unique1 = t2.thousand
+WHERE t2.unique1 < 1200;', true);
+
+SELECT COUNT(*), AVG(t1.unique1) FROM tenk1 t1
+INNER JOIN tenk1 t2 ON t1.unique1 = t2.thousand
+WHERE t2.unique1 < 1200;
+
+-- Check the results against a plan without Memoize
+SET enable_memoize TO off;
+SELECT COUNT(*), AVG(t1.unique1) FROM tenk1 t1
+INNER JOIN tenk1 t2 ON t1.unique1 = t2.thousand
+WHERE t2.unique1 < 1200;
+
+RESET enable_memoize;
+RESET work_mem;
+RESET enable_bitmapscan;
+RESET enable_mergejoin;
+RESET enable_hashjoin;
+
+DROP FUNCTION explain_memoize(text, bool);
@@ -749,6 +749,20 @@ WHERE a.aggfnoid = p.oid AND
      -- we could carry the check further, but 3 args is enough for now
     );
 
+-- Cross-check combinefn (if present) against its entry in pg_proc.
+-- It must take two transition values and return a transition value.
+-- NOTE: use physically_coercible here, as for transfn above.
+
+SELECT a.aggfnoid::oid, p.proname, pcf.oid, pcf.proname
+FROM pg_aggregate AS a, pg_proc AS p, pg_proc AS pcf
+WHERE a.aggfnoid = p.oid AND
+    a.aggcombinefn = pcf.oid AND
+    (pcf.proretset OR
+     pcf.pronargs != 2 OR
+     NOT physically_coercible(pcf.prorettype, a.aggtranstype) OR
+     NOT physically_coercible(a.aggtranstype, pcf.proargtypes[0]) OR
+     NOT physically_coercible(a.aggtranstype, pcf.proargtypes[1]));
+
 -- If transfn is strict then either initval should be non-NULL, or
 -- input type should match transtype so that the first non-null input
 -- can be assigned as the state value.
@@ -1286,6 +1300,28 @@ WHERE p3.opfmethod = (SELECT oid FROM pg_am WHERE amname = 'hash')
      OR amproclefttype != amprocrighttype)
 ORDER BY 1;
 
+-- BRIN bloom opclasses hash values with support routine 15, which must be
+-- of the same form as a hash opclass's, and multi-range minmax opclasses
+-- measure distances with routine 11, of the form distance(type, type)
+-- returns float8.  timestamptz cheats as in the hash case above.
+
+SELECT p1.amprocfamily, p1.amprocnum, p2.proname, p3.opfname
+FROM pg_amproc AS p1, pg_proc AS p2, pg_opfamily AS p3
+WHERE p3.opfmethod = (SELECT oid FROM pg_am WHERE amname = 'brin')
+    AND p1.amprocfamily = p3.oid AND p1.amproc = p2.oid AND
+    ((p3.opfname LIKE '%_bloom_ops' AND amprocnum = 15 AND
+      (proretset
+       OR prorettype != 'int4'::regtype
+       OR pronargs != 1
+       OR NOT physically_coercible(amproclefttype, proargtypes[0]))) OR
+     (p3.opfname LIKE '%_minmax_multi_ops' AND amprocnum = 11 AND
+      (proretset
+       OR prorettype != 'float8'::regtype
+       OR pronargs != 2
+       OR NOT physically_coercible(amproclefttype, proargtypes[0])
+       OR NOT physically_coercible(amprocrighttype, proargtypes[1]))))
+ORDER BY 1;
+
 -- We can also check SP-GiST carefully, since the support routine signatures
 -- are independent of the datatype being indexed.
 
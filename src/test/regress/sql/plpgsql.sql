@@ -4265,3 +4265,105 @@ exception when others then
   null; -- do nothing
 end;
 $$;
+
+--
+-- SELECT INTO inside loops, and assignments to fields of records
+--
+create temp table loop_into (id int primary key, val text);
+insert into loop_into select g, 'v' || g from generate_series(1, 10) g;
+
+do $$
+declare
+  t text := '';
+  v text;
+begin
+  for i in 1..12 loop
+    select val into v from loop_into where id = i;
+    if found then
+      t := t || v || ' ';
+    else
+      t := t || '- ';
+    end if;
+    if i = 6 then
+      update loop_into set val = 'new' where id = 8;
+    end if;
+  end loop;
+  raise notice '%', t;
+end$$;
+
+do $$
+declare
+  v text;
+begin
+  for i in 8..12 loop
+    begin
+      select val into strict v from loop_into where id = i;
+      raise notice '% -> %', i, v;
+    exception when no_data_found then
+      raise notice '% not found', i;
+    end;
+  end loop;
+end$$;
+
+do $$
+declare
+  v int;
+begin
+  for i in 1..10 loop
+    select 10 / (7 - id) into v from loop_into where id = i;
+  end loop;
+exception when division_by_zero then
+  raise notice 'caught division by zero';
+end$$;
+
+do $$
+declare
+  r record;
+begin
+  select * into r from loop_into where id = 2;
+  r.val := 'x';
+  r.val := r.val || 'y';
+  r.id := r.id + 100;
+  raise notice '% % %', r.id, r.val, r;
+  select * into r from loop_into where id = 3;
+  raise notice '%', r;
+end$$;
+
+create function loop_into_trig() returns trigger as $$
+begin
+  new.val := upper(new.val);
+  new.val := new.val || '!';
+  return new;
+end$$ language plpgsql;
+create trigger loop_into_trig before insert on loop_into
+  for each row execute procedure loop_into_trig();
+insert into loop_into values (11, 'abc') returning *;
+-- utility commands in the loop must not find the table in use
+do $$
+declare
+  v text;
+begin
+  for i in 1..3 loop
+    select val into v from loop_into where id = 11;
+    raise notice '%', v;
+    truncate loop_into;
+    insert into loop_into values (11, 'r' || i);
+  end loop;
+end$$;
+do $$
+declare
+  v text;
+begin
+  for i in 1..2 loop
+    select val into v from loop_into where id = 11;
+    raise notice '% %', i, v;
+    if i = 1 then
+      alter table loop_into add column extra int;
+    else
+      execute 'alter table loop_into drop column extra';
+    end if;
+  end loop;
+end$$;
+
+drop table loop_into;
+drop function loop_into_trig();
@@ -152,6 +152,18 @@ SELECT * FROM pxtest3;
 -- There should be no prepared transactions
 SELECT gid FROM pg_prepared_xacts;
 
+-- A snapshot taken after PREPARE TRANSACTION must still treat the prepared
+-- transaction as running, or its rows would be lost on COMMIT PREPARED
+CREATE TABLE pxtest5 (a int);
+BEGIN;
+INSERT INTO pxtest5 VALUES (1);
+INSERT INTO pxtest5 VALUES (2);
+PREPARE TRANSACTION 'regress-five';
+SELECT * FROM pxtest5 ORDER BY a;
+COMMIT PREPARED 'regress-five';
+SELECT * FROM pxtest5 ORDER BY a;
+DROP TABLE pxtest5;
+
 -- Clean up
 DROP TABLE pxtest2;
 DROP TABLE pxtest3;  -- will still be there if prepared xacts are disabled
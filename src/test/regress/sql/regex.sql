@@ -50,3 +50,10 @@ select regexp_matches('Programmer', '(\w)(.*?\1)', 'g');
 -- Test for proper matching of non-greedy iteration (bug #11478)
 select regexp_matches('foo/bar/baz',
                       '^([^/]+?)(?:/([^/]+?))(?:/([^/]+?))?$', '');
+
+-- Test the required-literal prefilter on patterns it does and doesn't analyze
+select 'request timeout' ~ 'time(out|d)' as t, 'request timed' ~ 'time(out|d)' as t;
+select 'abbc' ~ 'ab+c' as t, 'ac' ~ 'ab*c' as t, 'ac' ~ 'ab?c' as t;
+select 'Abcd' ~ '\u0041bcd' as t, 'x41bcd' ~ '\u0041bcd' as f;
+select 'TIMEOUT' ~* 'timeout' as t, 'TIMEOUT' ~ '(?i)timeout' as t;
+select 'xy' ~ 'ab|xy' as t, 'a.b' ~ 'a\.b' as t, 'axb' ~ 'a\.b' as f;
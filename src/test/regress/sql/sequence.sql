@@ -262,3 +262,14 @@ SELECT * FROM information_schema.sequences WHERE sequence_name IN
 
 DROP USER seq_user;
 DROP SEQUENCE seq;
+
+-- Values set aside in shared memory for sequences without CACHE
+SET sequence_shared_cache = 4;
+CREATE SEQUENCE seq_shared INCREMENT BY 2;
+SELECT nextval('seq_shared'), nextval('seq_shared'), nextval('seq_shared');
+SELECT setval('seq_shared', 100);
+SELECT nextval('seq_shared'), nextval('seq_shared');
+ALTER SEQUENCE seq_shared RESTART WITH 7;
+SELECT nextval('seq_shared');
+DROP SEQUENCE seq_shared;
+RESET sequence_shared_cache;
@@ -0,0 +1,64 @@
+--
+-- SESSION_STATE
+--
+-- pg_session_state() reports each kind of state that ties a session to its
+-- backend while it exists, and no longer once it has been cleaned up.
+
+SELECT pg_session_state();
+
+PREPARE session_state_stmt AS SELECT 1;
+SELECT pg_session_state();
+DEALLOCATE session_state_stmt;
+SELECT pg_session_state();
+
+BEGIN;
+DECLARE session_state_cur CURSOR WITH HOLD FOR SELECT 1;
+COMMIT;
+SELECT pg_session_state();
+CLOSE session_state_cur;
+SELECT pg_session_state();
+
+LISTEN session_state_channel;
+SELECT pg_session_state();
+UNLISTEN session_state_channel;
+SELECT pg_session_state();
+
+SELECT pg_advisory_lock(1);
+SELECT pg_session_state();
+SELECT pg_advisory_unlock(1);
+SELECT pg_session_state();
+
+-- transaction-level advisory locks don't outlive the transaction
+BEGIN;
+SELECT pg_advisory_xact_lock(2);
+SELECT pg_session_state();
+COMMIT;
+
+SET work_mem = '2MB';
+SELECT pg_session_state();
+RESET work_mem;
+SELECT pg_session_state();
+
+CREATE ROLE regress_session_state_role;
+SET ROLE regress_session_state_role;
+SELECT pg_session_state();
+RESET ROLE;
+SELECT pg_session_state();
+DROP ROLE regress_session_state_role;
+
+-- DISCARD ALL gets rid of everything at once
+PREPARE session_state_stmt AS SELECT 1;
+BEGIN;
+DECLARE session_state_cur CURSOR WITH HOLD FOR SELECT 1;
+COMMIT;
+LISTEN session_state_channel;
+SELECT pg_advisory_lock(1);
+SET work_mem = '2MB';
+SELECT pg_session_state();
+DISCARD ALL;
+SELECT pg_session_state();
+
+-- the temporary schema stays set up for the rest of the session
+CREATE TEMP TABLE session_state_tmp (a int);
+DROP TABLE session_state_tmp;
+SELECT pg_session_state();
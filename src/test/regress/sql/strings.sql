@@ -307,6 +307,15 @@ SELECT 'hawkeye' NOT ILIKE 'H%Eye' AS "false";
 SELECT 'Hawkeye' ILIKE 'h%' AS "true";
 SELECT 'Hawkeye' NOT ILIKE 'h%' AS "false";
 
+SELECT 'request timed out' ILIKE '%TIMED OUT%' AS "true";
+SELECT 'request timed out' NOT ILIKE '%TIMED OUT%' AS "false";
+
+SELECT 'a much longer message that says Request Timed Out at the end' ILIKE '%timed out%' AS "true";
+SELECT 'a much longer message that says Request Timed Out at the end' NOT ILIKE '%timed out%' AS "false";
+
+SELECT 'a much longer message that says request timed out at the end' ILIKE '%[timed out%' AS "false";
+SELECT 'a much longer message that says request timed out at the end' NOT ILIKE '%[timed out%' AS "true";
+
 --
 -- test %/_ combination cases, cf bugs #4821 and #5478
 --
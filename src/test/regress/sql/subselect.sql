@@ -481,3 +481,42 @@ select * from
   order by 1;
 
 select nextval('ts1');
+
+--
+-- Tests for CTE inlining behavior
+--
+
+-- Basic subquery that can be inlined
+explain (verbose, costs off)
+with x as (select * from (select f1 from subselect_tbl) ss)
+select * from x where f1 = 1;
+
+-- Explicitly request materialization
+explain (verbose, costs off)
+with x as materialized (select * from (select f1 from subselect_tbl) ss)
+select * from x where f1 = 1;
+
+-- Volatile functions prevent inlining
+explain (verbose, costs off)
+with x as (select * from (select f1, random() from subselect_tbl) ss)
+select * from x where f1 = 1;
+
+--
+-- Tests for NOT IN to anti-join conversion
+--
+create temp table notin_a (x int not null, y int);
+create temp table notin_b (x int not null, y int);
+insert into notin_a values (1, 1), (2, 2), (3, null);
+insert into notin_b values (1, null), (3, 3);
+
+-- both sides are NOT NULL, so an anti-join can be used
+explain (costs off)
+select * from notin_a where x not in (select x from notin_b);
+select * from notin_a where x not in (select x from notin_b);
+
+-- but not if either side might be NULL
+explain (costs off)
+select * from notin_a where y not in (select x from notin_b);
+explain (costs off)
+select * from notin_a where x not in (select y from notin_b);
+select * from notin_a where x not in (select y from notin_b);
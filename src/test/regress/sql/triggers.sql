@@ -1240,3 +1240,80 @@ select * from upsert;
 drop table upsert;
 drop function upsert_before_func();
 drop function upsert_after_func();
+
+--
+-- Test statement-level transition tables
+--
+create table transition_tab (id int primary key, val text);
+
+create function transition_tab_ins_func() returns trigger language plpgsql as
+$$
+declare
+  n text;
+begin
+  select string_agg(id || '=' || val, ',' order by id) into n
+    from pg_transition_table('newtab') as t(id int, val text);
+  raise info '%: new = %', tg_name, n;
+  return null;
+end;
+$$;
+
+create function transition_tab_upd_func() returns trigger language plpgsql as
+$$
+declare
+  o text;
+  n text;
+begin
+  select string_agg(id || '=' || val, ',' order by id) into o
+    from pg_transition_table('oldtab') as t(id int, val text);
+  select string_agg(id || '=' || val, ',' order by id) into n
+    from pg_transition_table('newtab') as t(id int, val text);
+  raise info '%: old = %, new = %', tg_name, o, n;
+  return null;
+end;
+$$;
+
+create trigger transition_tab_ins after insert on transition_tab
+  referencing new table as newtab
+  for each statement execute procedure transition_tab_ins_func();
+create trigger transition_tab_upd after update on transition_tab
+  referencing old table as oldtab new table newtab
+  for each statement execute procedure transition_tab_upd_func();
+
+select pg_get_triggerdef(oid) from pg_trigger where tgname = 'transition_tab_upd';
+
+insert into transition_tab values (1, 'one'), (2, 'two');
+insert into transition_tab values (3, 'three');
+update transition_tab set val = upper(val) where id >= 2;
+update transition_tab set val = val where false;
+copy transition_tab from stdin;
+4	four
+5	five
+\.
+
+-- transition tables are only visible to the trigger that names them
+select * from pg_transition_table('newtab') as t(id int, val text);
+
+-- invalid cases
+create trigger transition_tab_bad before insert on transition_tab
+  referencing new table as newtab
+  for each statement execute procedure transition_tab_ins_func();
+create trigger transition_tab_bad after delete on transition_tab
+  referencing new table as newtab
+  for each statement execute procedure transition_tab_ins_func();
+create trigger transition_tab_bad after insert on transition_tab
+  referencing old table as oldtab
+  for each statement execute procedure transition_tab_ins_func();
+create trigger transition_tab_bad after update on transition_tab
+  referencing old table as tab new table as tab
+  for each statement execute procedure transition_tab_upd_func();
+create trigger transition_tab_bad after truncate on transition_tab
+  referencing old table as oldtab
+  for each statement execute procedure transition_tab_upd_func();
+create trigger transition_tab_bad after update on transition_tab
+  referencing old row as oldrow
+  for each row execute procedure transition_tab_upd_func();
+
+drop table transition_tab;
+drop function transition_tab_ins_func();
+drop function transition_tab_upd_func();
@@ -292,6 +292,27 @@ SELECT * FROM
    FROM empsalary) emp
 WHERE depname = 'sales';
 
+-- Test Sort node collapsing
+EXPLAIN (COSTS OFF)
+SELECT * FROM
+  (SELECT depname,
+          sum(salary) OVER (PARTITION BY depname order by empno) depsalary,
+          min(salary) OVER (PARTITION BY depname, empno order by enroll_date) depminsalary
+   FROM empsalary) emp
+WHERE depname = 'sales';
+
+-- Test incremental sort between windows with the same partitioning
+EXPLAIN (COSTS OFF)
+SELECT depname, empno,
+       sum(salary) OVER (PARTITION BY depname ORDER BY empno) depsalary,
+       min(salary) OVER (PARTITION BY depname ORDER BY enroll_date) depminsalary
+FROM empsalary ORDER BY depname, empno;
+
+SELECT depname, empno,
+       sum(salary) OVER (PARTITION BY depname ORDER BY empno) depsalary,
+       min(salary) OVER (PARTITION BY depname ORDER BY enroll_date) depminsalary
+FROM empsalary ORDER BY depname, empno;
+
 -- cleanup
 DROP TABLE empsalary;
 
@@ -641,3 +662,12 @@ SELECT to_char(SUM(n::float8) OVER (ORDER BY i ROWS BETWEEN CURRENT ROW AND 1 FO
 SELECT i, b, bool_and(b) OVER w, bool_or(b) OVER w
   FROM (VALUES (1,true), (2,true), (3,false), (4,false), (5,true)) v(i,b)
   WINDOW w AS (ORDER BY i ROWS BETWEEN CURRENT ROW AND 1 FOLLOWING);
+
+-- min() and max() over moving frames use an extremum queue
+SELECT i, v, min(v) OVER w, max(v) OVER w, max(v) FILTER (WHERE i <> 3) OVER w
+  FROM (VALUES (1,3), (2,NULL), (3,5), (4,1), (5,4), (6,NULL), (7,NULL), (8,2)) t(i,v)
+  WINDOW w AS (ORDER BY i ROWS BETWEEN 1 PRECEDING AND 1 FOLLOWING);
+
+SELECT s, min(s) OVER w, max(s) OVER w
+  FROM (VALUES (1,'b'), (2,'d'), (3,'a'), (4,'c'), (5,'a')) t(i,s)
+  WINDOW w AS (ORDER BY i ROWS BETWEEN CURRENT ROW AND 2 FOLLOWING);
@@ -318,6 +318,30 @@ with recursive search_graph(f, t, label, path, cycle) as (
 )
 select * from search_graph order by path;
 
+-- CYCLE visits each value of the listed columns once
+with recursive reach(t, depth) as (
+	select 1, 0
+	union all
+	select g.t, r.depth + 1
+	from graph g, reach r
+	where g.f = r.t
+) cycle (t)
+select * from reach order by t;
+
+-- same, with the hash table of values seen spilled to temporary files
+set work_mem = 64;
+with recursive x(n) as (
+	select g from generate_series(1, 10000) g
+	union all
+	select (n * 2) % 20011 from x
+) cycle (n)
+select count(*), sum(n) from x;
+reset work_mem;
+
+-- CYCLE errors
+with x(n) as (select 1) cycle (n) select * from x;
+with recursive x(n) as (select 1 union all select n+1 from x where n < 3) cycle (m) select * from x;
+
 --
 -- test multiple WITH queries
 --